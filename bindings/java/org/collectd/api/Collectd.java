@@ -175,6 +175,20 @@ public class Collectd
   native public static int registerWrite (String name,
       CollectdWriteInterface object);
 
+  /**
+   * Registers a write callback which receives the value lists in batches.
+   * Value lists are encoded into a buffer as they are dispatched; a separate
+   * thread passes everything that has accumulated to the writeBatch method.
+   * At most queueLimit value lists are queued, further values are dropped
+   * until the callback catches up.
+   *
+   * @return Zero when successful, non-zero otherwise.
+   * @see CollectdBatchWriteInterface
+   * @see ValueListBatch
+   */
+  native public static int registerWriteBatch (String name,
+      CollectdBatchWriteInterface object, int queueLimit);
+
   /**
    * Java representation of collectd/src/plugin.h:plugin_register_flush
    *
@@ -0,0 +1,40 @@
+/**
+ * collectd - bindings/java/org/collectd/api/CollectdBatchWriteInterface.java
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+package org.collectd.api;
+
+import java.nio.ByteBuffer;
+
+/**
+ * Interface for objects implementing a batch write method.
+ *
+ * The buffer is a direct buffer holding <code>count</code> encoded value
+ * lists. It is only valid until the method returns, use
+ * {@link ValueListBatch} to decode it.
+ *
+ * @see Collectd#registerWriteBatch
+ */
+public interface CollectdBatchWriteInterface
+{
+	public int writeBatch (ByteBuffer buffer, int count);
+}
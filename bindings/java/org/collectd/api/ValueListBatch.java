@@ -0,0 +1,214 @@
+/**
+ * collectd - bindings/java/org/collectd/api/ValueListBatch.java
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+package org.collectd.api;
+
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.charset.Charset;
+
+/**
+ * Decoder for the buffers passed to
+ * {@link CollectdBatchWriteInterface#writeBatch}.
+ *
+ * The decoder is a cursor: {@link #next} moves to the next value list and
+ * the getters return the fields of the current one, reading them straight
+ * from the buffer. Only the string getters and {@link #toValueList} create
+ * objects.
+ *
+ * Each value list is encoded as follows, all integers in host byte order:
+ * <pre>
+ *   int32   size of the record in bytes
+ *   int16   number of values (n)
+ *   int16   reserved
+ *   int64   time, in milliseconds
+ *   int64   interval, in milliseconds
+ *   n * 8   values; double for gauges, int64 otherwise
+ *   n * 1   data source types (DataSource.TYPE_*)
+ *   5 times int16 length and UTF-8 bytes of host, plugin, plugin instance,
+ *           type and type instance
+ * </pre>
+ */
+public class ValueListBatch
+{
+    private static final int HEADER_SIZE = 24;
+    private static final Charset UTF8 = Charset.forName ("UTF-8");
+
+    private final ByteBuffer _buffer;
+    private final int _count;
+
+    private int _index;
+    private int _offset;
+    private int _next;
+    private int _valuesCount;
+
+    public ValueListBatch (ByteBuffer buffer, int count)
+    {
+        _buffer = buffer.order (ByteOrder.nativeOrder ());
+        _count = count;
+        rewind ();
+    }
+
+    /** Returns the number of value lists in the batch. */
+    public int size ()
+    {
+        return _count;
+    }
+
+    /** Moves the cursor in front of the first value list. */
+    public void rewind ()
+    {
+        _index = -1;
+        _offset = 0;
+        _next = 0;
+        _valuesCount = 0;
+    }
+
+    /**
+     * Moves the cursor to the next value list.
+     *
+     * @return False if there are no more value lists.
+     */
+    public boolean next ()
+    {
+        if ((_index + 1) >= _count)
+            return false;
+
+        _index++;
+        _offset = _next;
+        _next = _offset + _buffer.getInt (_offset);
+        _valuesCount = _buffer.getShort (_offset + 4) & 0xffff;
+        return true;
+    }
+
+    /** Returns the time of the current value list, in milliseconds. */
+    public long getTime ()
+    {
+        return _buffer.getLong (_offset + 8);
+    }
+
+    /** Returns the interval of the current value list, in milliseconds. */
+    public long getInterval ()
+    {
+        return _buffer.getLong (_offset + 16);
+    }
+
+    public int getValuesCount ()
+    {
+        return _valuesCount;
+    }
+
+    /** Returns the DataSource.TYPE_* of value <code>i</code>. */
+    public int getValueType (int i)
+    {
+        return _buffer.get (_offset + HEADER_SIZE + 8 * _valuesCount + i);
+    }
+
+    /** Returns value <code>i</code> of the current value list as double. */
+    public double getDouble (int i)
+    {
+        int pos = _offset + HEADER_SIZE + 8 * i;
+        if (getValueType (i) == DataSource.TYPE_GAUGE)
+            return _buffer.getDouble (pos);
+        return (double) _buffer.getLong (pos);
+    }
+
+    /** Returns value <code>i</code> of the current value list as long. */
+    public long getLong (int i)
+    {
+        int pos = _offset + HEADER_SIZE + 8 * i;
+        if (getValueType (i) == DataSource.TYPE_GAUGE)
+            return (long) _buffer.getDouble (pos);
+        return _buffer.getLong (pos);
+    }
+
+    /** Returns value <code>i</code> as Double for gauges, Long otherwise. */
+    public Number getValue (int i)
+    {
+        if (getValueType (i) == DataSource.TYPE_GAUGE)
+            return Double.valueOf (getDouble (i));
+        return Long.valueOf (getLong (i));
+    }
+
+    public String getHost ()
+    {
+        return getString (0);
+    }
+
+    public String getPlugin ()
+    {
+        return getString (1);
+    }
+
+    public String getPluginInstance ()
+    {
+        return getString (2);
+    }
+
+    public String getType ()
+    {
+        return getString (3);
+    }
+
+    public String getTypeInstance ()
+    {
+        return getString (4);
+    }
+
+    /**
+     * Copies the current value list into a new ValueList object. The data
+     * set is not set, use {@link Collectd#getDS} if it is needed.
+     */
+    public ValueList toValueList ()
+    {
+        ValueList vl = new ValueList ();
+
+        vl.setHost (getHost ());
+        vl.setPlugin (getPlugin ());
+        vl.setPluginInstance (getPluginInstance ());
+        vl.setType (getType ());
+        vl.setTypeInstance (getTypeInstance ());
+        vl.setTime (getTime ());
+        vl.setInterval (getInterval ());
+        for (int i = 0; i < _valuesCount; i++)
+            vl.addValue (getValue (i));
+
+        return vl;
+    }
+
+    private String getString (int n)
+    {
+        int pos = _offset + HEADER_SIZE + 9 * _valuesCount;
+        for (int i = 0; i < n; i++)
+            pos += 2 + (_buffer.getShort (pos) & 0xffff);
+
+        int len = _buffer.getShort (pos) & 0xffff;
+        byte[] bytes = new byte[len];
+        ByteBuffer dup = _buffer.duplicate ();
+        dup.position (pos + 2);
+        dup.get (bytes);
+        return new String (bytes, UTF8);
+    }
+}
+
+/* vim: set sw=4 sts=4 et : */
@@ -30,6 +30,13 @@ import java.util.List;
 import java.util.ArrayList;
 import java.util.Map;
 import java.util.TreeMap;
+import java.util.concurrent.Callable;
+import java.util.concurrent.ExecutionException;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import java.util.concurrent.Future;
+import java.util.concurrent.ThreadFactory;
+import java.util.concurrent.atomic.AtomicInteger;
 
 import org.collectd.api.Collectd;
 import org.collectd.api.CollectdConfigInterface;
@@ -38,6 +45,7 @@ import org.collectd.api.CollectdReadInterface;
 import org.collectd.api.CollectdShutdownInterface;
 import org.collectd.api.OConfigValue;
 import org.collectd.api.OConfigItem;
+import org.collectd.api.ValueList;
 
 public class GenericJMX implements CollectdConfigInterface,
        CollectdReadInterface,
@@ -48,6 +56,11 @@ public class GenericJMX implements CollectdConfigInterface,
 
   private List<GenericJMXConfConnection> _connections = null;
 
+  /* Connections are polled concurrently by up to _threads threads. The
+   * values are dispatched by the read thread. */
+  private int _threads = 1;
+  private ExecutorService _executor = null;
+
   public GenericJMX ()
   {
     Collectd.registerConfig   ("GenericJMX", this);
@@ -85,6 +98,21 @@ public class GenericJMX implements CollectdConfigInterface,
               + "Evaluating `MBean' block failed: " + e);
         }
       }
+      else if (key.equalsIgnoreCase ("Threads"))
+      {
+        List<OConfigValue> values = child.getValues ();
+        if ((values.size () != 1)
+            || (values.get (0).getType () != OConfigValue.OCONFIG_TYPE_NUMBER)
+            || (values.get (0).getNumber ().intValue () < 1))
+        {
+          Collectd.logError ("GenericJMX plugin: The `Threads' option needs "
+              + "exactly one positive numeric argument.");
+        }
+        else
+        {
+          this._threads = values.get (0).getNumber ().intValue ();
+        }
+      }
       else if (key.equalsIgnoreCase ("Connection"))
       {
         try
@@ -107,13 +135,81 @@ public class GenericJMX implements CollectdConfigInterface,
     return (0);
   } /* }}} int config */
 
+  private void dispatch (List<ValueList> values) /* {{{ */
+  {
+    for (int i = 0; i < values.size (); i++)
+      Collectd.dispatchValues (values.get (i));
+  } /* }}} void dispatch */
+
+  private ExecutorService getExecutor () /* {{{ */
+  {
+    if (this._executor != null)
+      return (this._executor);
+
+    int num = Math.min (this._threads, this._connections.size ());
+    this._executor = Executors.newFixedThreadPool (num, new ThreadFactory ()
+    {
+      private final AtomicInteger _num = new AtomicInteger (0);
+
+      public Thread newThread (Runnable r)
+      {
+        Thread t = new Thread (r, "GenericJMX#" + _num.getAndIncrement ());
+        t.setDaemon (true);
+        return (t);
+      }
+    });
+
+    return (this._executor);
+  } /* }}} ExecutorService getExecutor */
+
   public int read () /* {{{ */
   {
+    if ((this._threads <= 1) || (this._connections.size () <= 1))
+    {
+      for (int i = 0; i < this._connections.size (); i++)
+      {
+        try
+        {
+          dispatch (this._connections.get (i).query ());
+        }
+        catch (Exception e)
+        {
+          Collectd.logError ("GenericJMX: Caught unexpected exception: " + e);
+          e.printStackTrace ();
+        }
+      }
+
+      return (0);
+    }
+
+    /* Poll all connections at once, so that one slow server doesn't delay
+     * the others. */
+    List<Future<List<ValueList>>> futures
+      = new ArrayList<Future<List<ValueList>>> ();
     for (int i = 0; i < this._connections.size (); i++)
+    {
+      final GenericJMXConfConnection conn = this._connections.get (i);
+
+      futures.add (getExecutor ().submit (new Callable<List<ValueList>> ()
+      {
+        public List<ValueList> call ()
+        {
+          return (conn.query ());
+        }
+      }));
+    }
+
+    for (int i = 0; i < futures.size (); i++)
     {
       try
       {
-        this._connections.get (i).query ();
+        dispatch (futures.get (i).get ());
+      }
+      catch (ExecutionException e)
+      {
+        Collectd.logError ("GenericJMX: Caught unexpected exception: "
+            + e.getCause ());
+        e.getCause ().printStackTrace ();
       }
       catch (Exception e)
       {
@@ -128,6 +224,11 @@ public class GenericJMX implements CollectdConfigInterface,
   public int shutdown () /* {{{ */
   {
     System.out.print ("org.collectd.java.GenericJMX.Shutdown ();\n");
+    if (this._executor != null)
+    {
+      this._executor.shutdownNow ();
+      this._executor = null;
+    }
     this._connections = null;
     return (0);
   } /* }}} int shutdown */
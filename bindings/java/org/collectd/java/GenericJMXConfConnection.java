@@ -28,6 +28,7 @@ package org.collectd.java;
 
 import java.util.List;
 import java.util.Map;
+import java.util.Set;
 import java.util.Iterator;
 import java.util.ArrayList;
 import java.util.HashMap;
@@ -35,6 +36,7 @@ import java.net.InetAddress;
 import java.net.UnknownHostException;
 
 import javax.management.MBeanServerConnection;
+import javax.management.ObjectName;
 
 import javax.management.remote.JMXServiceURL;
 import javax.management.remote.JMXConnector;
@@ -42,6 +44,7 @@ import javax.management.remote.JMXConnectorFactory;
 
 import org.collectd.api.Collectd;
 import org.collectd.api.PluginData;
+import org.collectd.api.ValueList;
 import org.collectd.api.OConfigValue;
 import org.collectd.api.OConfigItem;
 
@@ -56,6 +59,12 @@ class GenericJMXConfConnection
   private MBeanServerConnection _mbean_connection = null;
   private List<GenericJMXConfMBean> _mbeans = null;
 
+  /* MBean names matching the object names of the MBean blocks, keyed by the
+   * blocks' names, and when they were looked up (System.nanoTime ()). */
+  private long _names_cache_time = 0;
+  private Map<String,Set<ObjectName>> _names = null;
+  private Map<String,Long> _names_update = null;
+
   /*
    * private methods
    */
@@ -83,6 +92,30 @@ class GenericJMXConfConnection
     return (v.getString ());
   } /* }}} String getConfigString */
 
+  private Number getConfigNumber (OConfigItem ci) /* {{{ */
+  {
+    List<OConfigValue> values;
+    OConfigValue v;
+
+    values = ci.getValues ();
+    if (values.size () != 1)
+    {
+      Collectd.logError ("GenericJMXConfConnection: The " + ci.getKey ()
+          + " configuration option needs exactly one numeric argument.");
+      return (null);
+    }
+
+    v = values.get (0);
+    if (v.getType () != OConfigValue.OCONFIG_TYPE_NUMBER)
+    {
+      Collectd.logError ("GenericJMXConfConnection: The " + ci.getKey ()
+          + " configuration option needs exactly one numeric argument.");
+      return (null);
+    }
+
+    return (v.getNumber ());
+  } /* }}} Number getConfigNumber */
+
   private String getHost () /* {{{ */
   {
     if (this._host != null)
@@ -148,8 +181,47 @@ class GenericJMXConfConnection
 
     this._jmx_connector = null;
     this._mbean_connection = null;
+    this._names.clear ();
+    this._names_update.clear ();
   } /* }}} void disconnect */
 
+  /* Returns the MBean names matching the object name of "mbean", looking them
+   * up at most once per ObjectNameCacheTime. Returns null if the lookup
+   * failed. */
+  private Set<ObjectName> getNames (GenericJMXConfMBean mbean) /* {{{ */
+  {
+    Set<ObjectName> names;
+    long now = System.nanoTime ();
+
+    if (this._names_cache_time > 0)
+    {
+      Long update = this._names_update.get (mbean.getName ());
+      if ((update != null)
+          && ((now - update.longValue ()) < this._names_cache_time))
+        return (this._names.get (mbean.getName ()));
+    }
+
+    try
+    {
+      names = mbean.queryNames (this._mbean_connection);
+    }
+    catch (Exception e)
+    {
+      Collectd.logError ("GenericJMXConfMBean: queryNames failed: " + e);
+      return (null);
+    }
+
+    /* An empty result is not cached, so that MBeans registered later are
+     * picked up on the next read. */
+    if ((this._names_cache_time > 0) && !names.isEmpty ())
+    {
+      this._names.put (mbean.getName (), names);
+      this._names_update.put (mbean.getName (), Long.valueOf (now));
+    }
+
+    return (names);
+  } /* }}} Set<ObjectName> getNames */
+
   /*
    * public methods
    *
@@ -158,6 +230,7 @@ class GenericJMXConfConnection
    *   ServiceURL "service:jmx:rmi:///jndi/rmi://localhost:17264/jmxrmi"
    *   Collect "java.lang:type=GarbageCollector,name=Copy"
    *   Collect "java.lang:type=Memory"
+   *   ObjectNameCacheTime 300
    * </Connection>
    *
    */
@@ -168,6 +241,8 @@ class GenericJMXConfConnection
     Iterator<OConfigItem> iter;
 
     this._mbeans = new ArrayList<GenericJMXConfMBean> ();
+    this._names = new HashMap<String,Set<ObjectName>> ();
+    this._names_update = new HashMap<String,Long> ();
 
     children = ci.getChildren ();
     iter = children.iterator ();
@@ -205,6 +280,12 @@ class GenericJMXConfConnection
         if (tmp != null)
           this._instance_prefix = tmp;
       }
+      else if (child.getKey ().equalsIgnoreCase ("ObjectNameCacheTime"))
+      {
+        Number tmp = getConfigNumber (child);
+        if (tmp != null)
+          this._names_cache_time = (long) (tmp.doubleValue () * 1000000000.0);
+      }
       else if (child.getKey ().equalsIgnoreCase ("Collect"))
       {
         String tmp = getConfigString (child);
@@ -233,15 +314,20 @@ class GenericJMXConfConnection
             + "present."));
   } /* }}} GenericJMXConfConnection (OConfigItem ci) */
 
-  public void query () /* {{{ */
+  /**
+   * Reads all configured MBeans and returns the resulting value lists. This
+   * does not dispatch them, so it may be called from any thread.
+   */
+  public List<ValueList> query () /* {{{ */
   {
     PluginData pd;
+    List<ValueList> ret = new ArrayList<ValueList> ();
 
     // try to connect
     connect ();
 
     if (this._mbean_connection == null)
-      return;
+      return (ret);
 
     Collectd.logDebug ("GenericJMXConfConnection.query: "
         + "Reading " + this._mbeans.size () + " mbeans from "
@@ -253,17 +339,33 @@ class GenericJMXConfConnection
 
     for (int i = 0; i < this._mbeans.size (); i++)
     {
+      GenericJMXConfMBean mbean = this._mbeans.get (i);
+      Set<ObjectName> names;
       int status;
 
-      status = this._mbeans.get (i).query (this._mbean_connection, pd,
-          this._instance_prefix);
-      if (status != 0)
+      names = getNames (mbean);
+      if (names == null)
+      {
+        disconnect ();
+        return (ret);
+      }
+
+      status = mbean.query (this._mbean_connection, pd,
+          this._instance_prefix, names, ret);
+      if (status < 0)
       {
         disconnect ();
-        return;
+        return (ret);
+      }
+      else if (status > 0)
+      {
+        /* Some MBeans went away, look the names up again next time. */
+        this._names_update.remove (mbean.getName ());
       }
     } /* for */
-  } /* }}} void query */
+
+    return (ret);
+  } /* }}} List<ValueList> query */
 
   public String toString ()
   {
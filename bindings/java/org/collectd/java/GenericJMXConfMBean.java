@@ -26,17 +26,24 @@
 
 package org.collectd.java;
 
+import java.io.IOException;
 import java.util.Iterator;
 import java.util.List;
+import java.util.Map;
 import java.util.Set;
 import java.util.ArrayList;
+import java.util.HashMap;
+import java.util.LinkedHashSet;
 
+import javax.management.Attribute;
+import javax.management.InstanceNotFoundException;
 import javax.management.MBeanServerConnection;
 import javax.management.ObjectName;
 import javax.management.MalformedObjectNameException;
 
 import org.collectd.api.Collectd;
 import org.collectd.api.PluginData;
+import org.collectd.api.ValueList;
 import org.collectd.api.OConfigValue;
 import org.collectd.api.OConfigItem;
 
@@ -47,6 +54,7 @@ class GenericJMXConfMBean
   private String _instance_prefix;
   private List<String> _instance_from;
   private List<GenericJMXConfValue> _values;
+  private String[] _attribute_names; /* read with one getAttributes () call */
 
   private String getConfigString (OConfigItem ci) /* {{{ */
   {
@@ -152,6 +160,10 @@ class GenericJMXConfMBean
     if (this._values.size () == 0)
       throw (new IllegalArgumentException ("No value block was defined."));
 
+    Set<String> names = new LinkedHashSet<String> ();
+    for (int i = 0; i < this._values.size (); i++)
+      names.addAll (this._values.get (i).getAttributeNames ());
+    this._attribute_names = names.toArray (new String[names.size ()]);
   } /* }}} GenericJMXConfMBean (OConfigItem ci) */
 
   public String getName () /* {{{ */
@@ -159,21 +171,29 @@ class GenericJMXConfMBean
     return (this._name);
   } /* }}} */
 
+  /**
+   * Returns the names of the MBeans matching this block's object name.
+   */
+  public Set<ObjectName> queryNames (MBeanServerConnection conn) /* {{{ */
+    throws Exception
+  {
+    return (conn.queryNames (this._obj_name, /* query = */ null));
+  } /* }}} Set<ObjectName> queryNames */
+
+  /**
+   * Reads the configured attributes of each MBean in <em>names</em>, see
+   * {@link #queryNames}, and appends the resulting value lists to
+   * <em>out</em>. All attributes of an MBean are fetched with one
+   * getAttributes () call.
+   *
+   * Returns zero upon success, a negative value if the connection failed and
+   * a positive value if some of the MBeans no longer exist.
+   */
   public int query (MBeanServerConnection conn, PluginData pd, /* {{{ */
-      String instance_prefix)
+      String instance_prefix, Set<ObjectName> names, List<ValueList> out)
   {
-    Set<ObjectName> names;
     Iterator<ObjectName> iter;
-
-    try
-    {
-      names = conn.queryNames (this._obj_name, /* query = */ null);
-    }
-    catch (Exception e)
-    {
-      Collectd.logError ("GenericJMXConfMBean: queryNames failed: " + e);
-      return (-1);
-    }
+    int status = 0;
 
     if (names.size () == 0)
     {
@@ -232,12 +252,38 @@ class GenericJMXConfMBean
 
       Collectd.logDebug ("GenericJMXConfMBean: instance = " + instance.toString ());
 
+      Map<String,Object> attributes = new HashMap<String,Object> ();
+      try
+      {
+        List<Attribute> list = conn.getAttributes (objName,
+            this._attribute_names).asList ();
+        for (int i = 0; i < list.size (); i++)
+          attributes.put (list.get (i).getName (), list.get (i).getValue ());
+      }
+      catch (InstanceNotFoundException e)
+      {
+        Collectd.logDebug ("GenericJMXConfMBean: " + objName
+            + " no longer exists.");
+        status = 1;
+        continue;
+      }
+      catch (IOException e)
+      {
+        Collectd.logError ("GenericJMXConfMBean: getAttributes failed: " + e);
+        return (-1);
+      }
+      catch (Exception e)
+      {
+        /* Fall back to reading the attributes one by one. */
+        Collectd.logDebug ("GenericJMXConfMBean: getAttributes failed: " + e);
+      }
+
       for (int i = 0; i < this._values.size (); i++)
-        this._values.get (i).query (conn, objName, pd_tmp);
+        this._values.get (i).query (conn, objName, pd_tmp, attributes, out);
     }
 
-    return (0);
-  } /* }}} void query */
+    return (status);
+  } /* }}} int query */
 }
 
 /* vim: set sw=2 sts=2 et fdm=marker : */
@@ -28,6 +28,7 @@ package org.collectd.java;
 
 import java.util.Arrays;
 import java.util.List;
+import java.util.Map;
 import java.util.Collection;
 import java.util.Set;
 import java.util.concurrent.atomic.AtomicInteger;
@@ -69,7 +70,7 @@ class GenericJMXConfValue {
 private
   String _ds_name;
 private
-  DataSet _ds;
+  volatile DataSet _ds;
 private
   List<String> _attributes;
 private
@@ -182,7 +183,7 @@ private
 
 private
   void submitTable(List<Object> objects, ValueList vl, /* {{{ */
-                   String instancePrefix) {
+                   String instancePrefix, List<ValueList> out) {
     List<CompositeData> cdlist;
     Set<String> keySet = null;
     Iterator<String> keyIter;
@@ -233,13 +234,13 @@ private
         vl.setTypeInstance(instancePrefix + key);
       vl.setValues(values);
 
-      Collectd.dispatchValues(vl);
+      out.add(new ValueList(vl));
     }
   } /* }}} void submitTable */
 
 private
   void submitScalar(List<Object> objects, ValueList vl, /* {{{ */
-                    String instancePrefix) {
+                    String instancePrefix, List<ValueList> out) {
     List<Number> values;
 
     values = genericListToNumber(objects);
@@ -255,7 +256,7 @@ private
       vl.setTypeInstance(instancePrefix);
     vl.setValues(values);
 
-    Collectd.dispatchValues(vl);
+    out.add(vl);
   } /* }}} void submitScalar */
 
 private
@@ -317,7 +318,8 @@ private
 
 private
   Object queryAttribute(MBeanServerConnection conn, /* {{{ */
-                        ObjectName objName, String attrName) {
+                        ObjectName objName, String attrName,
+                        Map<String, Object> attributes) {
     List<String> attrNameList;
     String key;
     Object value;
@@ -331,11 +333,17 @@ private
       attrNameList.add(attrNameArray[i]);
 
     try {
-      try {
-        value = conn.getAttribute(objName, key);
-      } catch (javax.management.AttributeNotFoundException e) {
-        value =
-            conn.invoke(objName, key, /* args = */ null, /* types = */ null);
+      /* Attributes missing from the prefetched ones are read on their own, so
+       * that operations can be invoked as before. */
+      if ((attributes != null) && attributes.containsKey(key)) {
+        value = attributes.get(key);
+      } else {
+        try {
+          value = conn.getAttribute(objName, key);
+        } catch (javax.management.AttributeNotFoundException e) {
+          value =
+              conn.invoke(objName, key, /* args = */ null, /* types = */ null);
+        }
       }
     } catch (Exception e) {
       Collectd.logError("GenericJMXConfValue.query: getAttribute failed: " + e);
@@ -500,17 +508,37 @@ public
   } /* }}} GenericJMXConfValue (OConfigItem ci) */
 
   /**
-   * Query values via JMX according to the object's configuration and dispatch
-   * them to collectd.
+   * Returns the names of the MBean attributes read by this value, i.e. the
+   * first component of each configured attribute path.
+   */
+public
+  List<String> getAttributeNames() /* {{{ */
+  {
+    List<String> ret = new ArrayList<String>();
+
+    for (int i = 0; i < this._attributes.size(); i++)
+      ret.add(this._attributes.get(i).split("\\.")[0]);
+
+    return (ret);
+  } /* }}} List<String> getAttributeNames */
+
+  /**
+   * Query values via JMX according to the object's configuration and collect
+   * them for dispatching.
    *
-   * @param conn    Connection to the MBeanServer.
-   * @param objName Object name of the MBean to query.
-   * @param pd      Preset naming components. The members host, plugin and
-   *                plugin instance will be used.
+   * @param conn       Connection to the MBeanServer.
+   * @param objName    Object name of the MBean to query.
+   * @param pd         Preset naming components. The members host, plugin and
+   *                   plugin instance will be used.
+   * @param attributes Attribute values already fetched from the MBean, keyed
+   *                   by attribute name. Other attributes are read from
+   *                   <em>conn</em>. May be null.
+   * @param out        List the resulting value lists are appended to.
    */
 public
   void query(MBeanServerConnection conn, ObjectName objName, /* {{{ */
-             PluginData pd) {
+             PluginData pd, Map<String, Object> attributes,
+             List<ValueList> out) {
     ValueList vl;
     List<DataSource> dsrc;
     List<Object> values;
@@ -577,7 +605,7 @@ public
     for (int i = 0; i < this._attributes.size(); i++) {
       Object v;
 
-      v = queryAttribute(conn, objName, this._attributes.get(i));
+      v = queryAttribute(conn, objName, this._attributes.get(i), attributes);
       if (v == null) {
         Collectd.logError(
             "GenericJMXConfValue.query: " + "Querying attribute " +
@@ -589,9 +617,9 @@ public
     }
 
     if (this._is_table)
-      submitTable(values, vl, instancePrefix);
+      submitTable(values, vl, instancePrefix, out);
     else
-      submitScalar(values, vl, instancePrefix);
+      submitScalar(values, vl, instancePrefix, out);
   } /* }}} void query */
 } /* class GenericJMXConfValue */
 
@@ -40,6 +40,7 @@ our @ISA = qw( Exporter );
 our %EXPORT_TAGS = (
 	'plugin' => [ qw(
 			plugin_register
+			plugin_register_write_batch
 			plugin_unregister
 			plugin_dispatch_values
 			plugin_get_interval
@@ -311,6 +312,30 @@ sub plugin_register {
 	return 1;
 }
 
+# Registers a write callback which is handed the value lists in batches by
+# a separate thread. The sub receives a reference to an array of
+# [ $type, $data_set, $value_list ] entries. Unregister it with
+# plugin_unregister (TYPE_WRITE, $name).
+sub plugin_register_write_batch {
+	my $name = shift;
+	my $data = shift;
+	my %opts = @_;
+
+	if (! ((defined $name) && (defined $data) && (! ref $data))) {
+		ERROR ("Usage: Collectd::plugin_register_write_batch (name, subname"
+			. "[, batch_size => n][, queue_limit => n])");
+		return;
+	}
+
+	my $pkg = scalar caller;
+	if ($data !~ m/^$pkg\:\:/) {
+		$data = $pkg . "::" . $data;
+	}
+
+	return _plugin_register_write_batch ($name, $data,
+		$opts{'batch_size'} || 1024, $opts{'queue_limit'} || 65536);
+}
+
 sub plugin_unregister {
 	my $type = shift;
 	my $name = shift;
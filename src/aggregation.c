@@ -57,14 +57,14 @@ struct aggregation_s /* {{{ */
 }; /* }}} */
 typedef struct aggregation_s aggregation_t;
 
-struct agg_instance_s;
-typedef struct agg_instance_s agg_instance_t;
-struct agg_instance_s /* {{{ */
+/* Values are accumulated in one of several stripes, chosen per write thread,
+ * so that threads updating the same instance rarely contend for a lock. The
+ * stripes are merged when the instance is read. */
+#define AGG_STRIPES_NUM 8
+
+struct agg_stripe_s /* {{{ */
 {
   pthread_mutex_t lock;
-  lookup_identifier_t ident;
-
-  int ds_type;
 
   derive_t num;
   gauge_t sum;
@@ -72,6 +72,18 @@ struct agg_instance_s /* {{{ */
 
   gauge_t min;
   gauge_t max;
+} __attribute__((aligned(64))); /* }}} */
+typedef struct agg_stripe_s agg_stripe_t;
+
+struct agg_instance_s;
+typedef struct agg_instance_s agg_instance_t;
+struct agg_instance_s /* {{{ */
+{
+  agg_stripe_t stripes[AGG_STRIPES_NUM];
+
+  lookup_identifier_t ident;
+
+  int ds_type;
 
   rate_to_value_state_t *state_num;
   rate_to_value_state_t *state_sum;
@@ -85,6 +97,9 @@ struct agg_instance_s /* {{{ */
 
 static lookup_t *lookup;
 
+static size_t agg_stripes_next;
+static __thread size_t agg_stripe_index = SIZE_MAX;
+
 static pthread_mutex_t agg_instance_list_lock = PTHREAD_MUTEX_INITIALIZER;
 static agg_instance_t *agg_instance_list_head;
 
@@ -134,12 +149,22 @@ static void agg_instance_destroy(agg_instance_t *inst) /* {{{ */
   sfree(inst->state_max);
   sfree(inst->state_stddev);
 
+  for (size_t i = 0; i < AGG_STRIPES_NUM; i++)
+    pthread_mutex_destroy(&inst->stripes[i].lock);
+
   memset(inst, 0, sizeof(*inst));
   inst->ds_type = -1;
-  inst->min = NAN;
-  inst->max = NAN;
 } /* }}} void agg_instance_destroy */
 
+static void agg_stripe_reset(agg_stripe_t *stripe) /* {{{ */
+{
+  stripe->num = 0;
+  stripe->sum = 0.0;
+  stripe->squares_sum = 0.0;
+  stripe->min = NAN;
+  stripe->max = NAN;
+} /* }}} void agg_stripe_reset */
+
 static int agg_instance_create_name(agg_instance_t *inst, /* {{{ */
                                     value_list_t const *vl,
                                     aggregation_t const *agg) {
@@ -233,20 +258,23 @@ static agg_instance_t *agg_instance_create(data_set_t const *ds, /* {{{ */
                                            aggregation_t *agg) {
   DEBUG("aggregation plugin: Creating new instance.");
 
-  agg_instance_t *inst = calloc(1, sizeof(*inst));
-  if (inst == NULL) {
-    ERROR("aggregation plugin: calloc() failed.");
+  agg_instance_t *inst = NULL;
+  if (posix_memalign((void **)&inst, _Alignof(agg_instance_t),
+                     sizeof(*inst)) != 0) {
+    ERROR("aggregation plugin: posix_memalign() failed.");
     return NULL;
   }
-  pthread_mutex_init(&inst->lock, /* attr = */ NULL);
+  memset(inst, 0, sizeof(*inst));
+
+  for (size_t i = 0; i < AGG_STRIPES_NUM; i++) {
+    pthread_mutex_init(&inst->stripes[i].lock, /* attr = */ NULL);
+    agg_stripe_reset(inst->stripes + i);
+  }
 
   inst->ds_type = ds->ds[0].type;
 
   agg_instance_create_name(inst, vl, agg);
 
-  inst->min = NAN;
-  inst->max = NAN;
-
 #define INIT_STATE(field)                                                      \
   do {                                                                         \
     inst->state_##field = NULL;                                                \
@@ -306,18 +334,24 @@ static int agg_instance_update(agg_instance_t *inst, /* {{{ */
     return 0;
   }
 
-  pthread_mutex_lock(&inst->lock);
+  if (agg_stripe_index == SIZE_MAX)
+    agg_stripe_index =
+        __atomic_fetch_add(&agg_stripes_next, 1, __ATOMIC_RELAXED) %
+        AGG_STRIPES_NUM;
+  agg_stripe_t *stripe = inst->stripes + agg_stripe_index;
 
-  inst->num++;
-  inst->sum += rate[0];
-  inst->squares_sum += (rate[0] * rate[0]);
+  pthread_mutex_lock(&stripe->lock);
 
-  if (isnan(inst->min) || (inst->min > rate[0]))
-    inst->min = rate[0];
-  if (isnan(inst->max) || (inst->max < rate[0]))
-    inst->max = rate[0];
+  stripe->num++;
+  stripe->sum += rate[0];
+  stripe->squares_sum += (rate[0] * rate[0]);
 
-  pthread_mutex_unlock(&inst->lock);
+  if (isnan(stripe->min) || (stripe->min > rate[0]))
+    stripe->min = rate[0];
+  if (isnan(stripe->max) || (stripe->max < rate[0]))
+    stripe->max = rate[0];
+
+  pthread_mutex_unlock(&stripe->lock);
 
   sfree(rate);
   return 0;
@@ -391,30 +425,42 @@ static int agg_instance_read(agg_instance_t *inst, cdtime_t t) /* {{{ */
     }                                                                          \
   } while (0)
 
-  pthread_mutex_lock(&inst->lock);
+  /* Merge and reset the stripes. Reads are serialized by
+   * agg_instance_list_lock, so the rate_to_value() states need no lock. */
+  agg_stripe_t total;
+  agg_stripe_reset(&total);
 
-  READ_FUNC(num, (gauge_t)inst->num);
+  for (size_t i = 0; i < AGG_STRIPES_NUM; i++) {
+    agg_stripe_t *stripe = inst->stripes + i;
 
-  /* All other aggregations are only defined when there have been any values
-   * at all. */
-  if (inst->num > 0) {
-    READ_FUNC(sum, inst->sum);
-    READ_FUNC(average, (inst->sum / ((gauge_t)inst->num)));
-    READ_FUNC(min, inst->min);
-    READ_FUNC(max, inst->max);
-    READ_FUNC(stddev, sqrt((((gauge_t)inst->num) * inst->squares_sum) -
-                           (inst->sum * inst->sum)) /
-                          ((gauge_t)inst->num));
+    pthread_mutex_lock(&stripe->lock);
+    if (stripe->num > 0) {
+      total.num += stripe->num;
+      total.sum += stripe->sum;
+      total.squares_sum += stripe->squares_sum;
+
+      if (isnan(total.min) || (total.min > stripe->min))
+        total.min = stripe->min;
+      if (isnan(total.max) || (total.max < stripe->max))
+        total.max = stripe->max;
+    }
+    agg_stripe_reset(stripe);
+    pthread_mutex_unlock(&stripe->lock);
   }
 
-  /* Reset internal state. */
-  inst->num = 0;
-  inst->sum = 0.0;
-  inst->squares_sum = 0.0;
-  inst->min = NAN;
-  inst->max = NAN;
+  READ_FUNC(num, (gauge_t)total.num);
 
-  pthread_mutex_unlock(&inst->lock);
+  /* All other aggregations are only defined when there have been any values
+   * at all. */
+  if (total.num > 0) {
+    READ_FUNC(sum, total.sum);
+    READ_FUNC(average, (total.sum / ((gauge_t)total.num)));
+    READ_FUNC(min, total.min);
+    READ_FUNC(max, total.max);
+    READ_FUNC(stddev, sqrt((((gauge_t)total.num) * total.squares_sum) -
+                           (total.sum * total.sum)) /
+                          ((gauge_t)total.num));
+  }
 
   meta_data_destroy(vl.meta);
   vl.meta = NULL;
@@ -33,6 +33,7 @@
 #include "utils/common/common.h"
 #include "utils/format_graphite/format_graphite.h"
 #include "utils/format_json/format_json.h"
+#include "utils/strbuf/strbuf.h"
 #include "utils_random.h"
 
 #include <amqp.h>
@@ -64,6 +65,16 @@ int amqp_socket_close(amqp_socket_t *);
 
 #define CAMQP_CHANNEL 1
 
+#define CAMQP_DEFAULT_MAX_UNCONFIRMED 1000
+#define CAMQP_DEFAULT_CONFIRM_TIMEOUT TIME_T_TO_CDTIME_T(10)
+
+/* Publisher confirms need amqp_simple_wait_frame_noblock(). */
+#if defined(AMQP_VERSION) && AMQP_VERSION >= 0x00040000
+#define CAMQP_HAVE_CONFIRMS 1
+#else
+#define CAMQP_HAVE_CONFIRMS 0
+#endif
+
 /*
  * Data types
  */
@@ -90,6 +101,7 @@ struct camqp_config_s {
 
   /* Number of seconds to wait before connection is retried */
   int connection_retry_delay;
+  time_t last_connect_time;
 
   /* publish only */
   uint8_t delivery_mode;
@@ -100,12 +112,33 @@ struct camqp_config_s {
   char *postfix;
   char escape_char;
   unsigned int graphite_flags;
+  /* publish & batching only */
+  size_t batch_size;
+  cdtime_t batch_timeout;
+  strbuf_t batch;
+  /* publish & publisher confirms only. "confirm_pending" is a ring buffer
+   * indexed by delivery tag, holding the messages in
+   * [confirm_first, confirm_next) which the broker has not confirmed yet. */
+  bool confirm;
+  size_t confirm_max;
+  cdtime_t confirm_timeout;
+  bool *confirm_pending;
+  uint64_t confirm_first;
+  uint64_t confirm_next;
 
   /* subscribe only */
   char *exchange_type;
   char *queue;
   bool queue_durable;
   bool queue_auto_delete;
+  size_t threads_num;
+  /* subscribe & manual acknowledgements only */
+  uint16_t prefetch;
+  uint16_t unacked;
+  uint64_t unacked_tag;
+  /* Set for the copies used by additional subscriber threads: they have a
+   * connection of their own, but the strings belong to the original. */
+  bool shared;
 
   amqp_connection_state_t connection;
   pthread_mutex_t lock;
@@ -120,8 +153,13 @@ static const char *def_user = "guest";
 static const char *def_password = "guest";
 static const char *def_exchange = "amq.fanout";
 
-static pthread_t *subscriber_threads;
-static size_t subscriber_threads_num;
+typedef struct {
+  pthread_t thread;
+  camqp_config_t *conf;
+} camqp_subscriber_t;
+
+static camqp_subscriber_t *subscribers;
+static size_t subscribers_num;
 static bool subscriber_threads_running = true;
 
 #define CONF(c, f) (((c)->f != NULL) ? (c)->f : def_##f)
@@ -136,6 +174,14 @@ static void camqp_close_connection(camqp_config_t *conf) /* {{{ */
   if ((conf == NULL) || (conf->connection == NULL))
     return;
 
+  if (conf->confirm) {
+    uint64_t unconfirmed = conf->confirm_next - conf->confirm_first;
+    if (unconfirmed > 0)
+      WARNING("amqp plugin: Closing the connection with %" PRIu64 " messages "
+              "not confirmed by the broker. They may have been lost.",
+              unconfirmed);
+  }
+
   sockfd = amqp_get_sockfd(conf->connection);
   amqp_channel_close(conf->connection, CAMQP_CHANNEL, AMQP_REPLY_SUCCESS);
   amqp_connection_close(conf->connection, AMQP_REPLY_SUCCESS);
@@ -144,6 +190,10 @@ static void camqp_close_connection(camqp_config_t *conf) /* {{{ */
   conf->connection = NULL;
 } /* }}} void camqp_close_connection */
 
+#if CAMQP_HAVE_CONFIRMS
+static int camqp_confirm_wait(camqp_config_t *conf, uint64_t limit);
+#endif
+
 static void camqp_config_free(void *ptr) /* {{{ */
 {
   camqp_config_t *conf = ptr;
@@ -151,8 +201,21 @@ static void camqp_config_free(void *ptr) /* {{{ */
   if (conf == NULL)
     return;
 
+#if CAMQP_HAVE_CONFIRMS
+  /* give the broker a chance to confirm everything sent so far */
+  if (conf->confirm && (conf->connection != NULL))
+    camqp_confirm_wait(conf, /* limit = */ 0);
+#endif
   camqp_close_connection(conf);
 
+  sfree(conf->confirm_pending);
+  STRBUF_DESTROY(conf->batch);
+
+  if (conf->shared) {
+    sfree(conf);
+    return;
+  }
+
   sfree(conf->name);
   strarray_free(conf->hosts, conf->hosts_count);
   sfree(conf->vhost);
@@ -387,13 +450,32 @@ static int camqp_setup_queue(camqp_config_t *conf) /* {{{ */
           conf->queue, conf->exchange);
   } /* if (conf->exchange != NULL) */
 
+  /* Without acknowledgements the broker sends as fast as it can, so the
+   * prefetch count only applies to them. */
+  if (conf->prefetch > 0) {
+    amqp_basic_qos_ok_t *qos_ret =
+        amqp_basic_qos(conf->connection,
+                       /* channel        = */ CAMQP_CHANNEL,
+                       /* prefetch_size  = */ 0,
+                       /* prefetch_count = */ conf->prefetch,
+                       /* global         = */ 0);
+    if ((qos_ret == NULL) && camqp_is_error(conf)) {
+      char errbuf[1024];
+      ERROR("amqp plugin: amqp_basic_qos failed: %s",
+            camqp_strerror(conf, errbuf, sizeof(errbuf)));
+      camqp_close_connection(conf);
+      return -1;
+    }
+  }
+  conf->unacked = 0;
+
   cm_ret =
       amqp_basic_consume(conf->connection,
                          /* channel      = */ CAMQP_CHANNEL,
                          /* queue        = */ amqp_cstring_bytes(conf->queue),
                          /* consumer_tag = */ AMQP_EMPTY_BYTES,
                          /* no_local     = */ 0,
-                         /* no_ack       = */ 1,
+                         /* no_ack       = */ (conf->prefetch == 0),
                          /* exclusive    = */ 0,
                          /* arguments    = */ AMQP_EMPTY_TABLE);
   if ((cm_ret == NULL) && camqp_is_error(conf)) {
@@ -407,10 +489,30 @@ static int camqp_setup_queue(camqp_config_t *conf) /* {{{ */
   return 0;
 } /* }}} int camqp_setup_queue */
 
-static int camqp_connect(camqp_config_t *conf) /* {{{ */
+#if CAMQP_HAVE_CONFIRMS
+static int camqp_confirm_select(camqp_config_t *conf) /* {{{ */
 {
-  static time_t last_connect_time;
+  amqp_confirm_select_ok_t *cs_ret =
+      amqp_confirm_select(conf->connection, CAMQP_CHANNEL);
+  if ((cs_ret == NULL) && camqp_is_error(conf)) {
+    char errbuf[1024];
+    ERROR("amqp plugin: amqp_confirm_select failed: %s",
+          camqp_strerror(conf, errbuf, sizeof(errbuf)));
+    camqp_close_connection(conf);
+    return -1;
+  }
 
+  /* Delivery tags start at one on every new channel. */
+  memset(conf->confirm_pending, 0,
+         conf->confirm_max * sizeof(*conf->confirm_pending));
+  conf->confirm_first = 1;
+  conf->confirm_next = 1;
+  return 0;
+} /* }}} int camqp_confirm_select */
+#endif
+
+static int camqp_connect(camqp_config_t *conf) /* {{{ */
+{
   amqp_rpc_reply_t reply;
   int status;
 #ifdef HAVE_AMQP_TCP_SOCKET
@@ -423,14 +525,14 @@ static int camqp_connect(camqp_config_t *conf) /* {{{ */
     return 0;
 
   time_t now = time(NULL);
-  if (now < (last_connect_time + conf->connection_retry_delay)) {
+  if (now < (conf->last_connect_time + conf->connection_retry_delay)) {
     DEBUG("amqp plugin: skipping connection retry, "
           "ConnectionRetryDelay: %d",
           conf->connection_retry_delay);
     return 1;
   } else {
     DEBUG("amqp plugin: retrying connection");
-    last_connect_time = now;
+    conf->last_connect_time = now;
   }
 
   conf->connection = amqp_new_connection();
@@ -550,25 +652,34 @@ static int camqp_connect(camqp_config_t *conf) /* {{{ */
 
   if (!conf->publish)
     return camqp_setup_queue(conf);
+#if CAMQP_HAVE_CONFIRMS
+  if (conf->confirm)
+    return camqp_confirm_select(conf);
+#endif
   return 0;
 } /* }}} int camqp_connect */
 
 static int camqp_shutdown(void) /* {{{ */
 {
   DEBUG("amqp plugin: Shutting down %" PRIsz " subscriber threads.",
-        subscriber_threads_num);
+        subscribers_num);
 
   subscriber_threads_running = 0;
-  for (size_t i = 0; i < subscriber_threads_num; i++) {
+  for (size_t i = 0; i < subscribers_num; i++) {
     /* FIXME: Sending a signal is not very elegant here. Maybe find out how
      * to use a timeout in the thread and check for the variable in regular
      * intervals. */
-    pthread_kill(subscriber_threads[i], SIGTERM);
-    pthread_join(subscriber_threads[i], /* retval = */ NULL);
+    pthread_kill(subscribers[i].thread, SIGTERM);
+    pthread_join(subscribers[i].thread, /* retval = */ NULL);
   }
 
-  subscriber_threads_num = 0;
-  sfree(subscriber_threads);
+  /* Copies of a configuration are added after the original, so free them in
+   * reverse order while the original's strings are still valid. */
+  for (size_t i = subscribers_num; i > 0; i--)
+    camqp_config_free(subscribers[i - 1].conf);
+
+  subscribers_num = 0;
+  sfree(subscribers);
 
   DEBUG("amqp plugin: All subscriber threads exited.");
 
@@ -578,16 +689,39 @@ static int camqp_shutdown(void) /* {{{ */
 /*
  * Subscribing code
  */
+static int camqp_handle_putval(char *body) /* {{{ */
+{
+  int status = 0;
+  char *saveptr = NULL;
+
+  /* Batches hold one command per line. */
+  for (char *line = strtok_r(body, "\r\n", &saveptr); line != NULL;
+       line = strtok_r(NULL, "\r\n", &saveptr)) {
+    int tmp = cmd_handle_putval(stderr, line);
+    if (tmp != 0) {
+      ERROR("amqp plugin: cmd_handle_putval failed with status %i.", tmp);
+      status = tmp;
+    }
+  }
+
+  return status;
+} /* }}} int camqp_handle_putval */
+
 static int camqp_read_body(camqp_config_t *conf, /* {{{ */
                            size_t body_size, const char *content_type) {
-  char body[body_size + 1];
+  char *body;
   char *body_ptr;
   size_t received;
   amqp_frame_t frame;
   int status;
 
-  memset(body, 0, sizeof(body));
-  body_ptr = &body[0];
+  /* Batched messages may be too large for the stack. */
+  body = calloc(1, body_size + 1);
+  if (body == NULL) {
+    ERROR("amqp plugin: calloc failed.");
+    return ENOMEM;
+  }
+  body_ptr = body;
   received = 0;
 
   while (received < body_size) {
@@ -596,16 +730,19 @@ static int camqp_read_body(camqp_config_t *conf, /* {{{ */
       status = (-1) * status;
       ERROR("amqp plugin: amqp_simple_wait_frame failed: %s", STRERROR(status));
       camqp_close_connection(conf);
+      sfree(body);
       return status;
     }
 
     if (frame.frame_type != AMQP_FRAME_BODY) {
       NOTICE("amqp plugin: Unexpected frame type: %#" PRIx8, frame.frame_type);
+      sfree(body);
       return -1;
     }
 
     if ((body_size - received) < frame.payload.body_fragment.len) {
       WARNING("amqp plugin: Body is larger than indicated by header.");
+      sfree(body);
       return -1;
     }
 
@@ -616,22 +753,19 @@ static int camqp_read_body(camqp_config_t *conf, /* {{{ */
   } /* while (received < body_size) */
 
   if (strcasecmp("text/collectd", content_type) == 0) {
-    status = cmd_handle_putval(stderr, body);
-    if (status != 0)
-      ERROR("amqp plugin: cmd_handle_putval failed with status %i.", status);
-    return status;
+    status = camqp_handle_putval(body);
   } else if (strcasecmp("application/json", content_type) == 0) {
     ERROR("amqp plugin: camqp_read_body: Parsing JSON data has not "
           "been implemented yet. FIXME!");
-    return 0;
+    status = 0;
   } else {
     ERROR("amqp plugin: camqp_read_body: Unknown content type \"%s\".",
           content_type);
-    return EINVAL;
+    status = EINVAL;
   }
 
-  /* not reached */
-  return 0;
+  sfree(body);
+  return status;
 } /* }}} int camqp_read_body */
 
 static int camqp_read_header(camqp_config_t *conf) /* {{{ */
@@ -668,6 +802,30 @@ static int camqp_read_header(camqp_config_t *conf) /* {{{ */
   return status;
 } /* }}} int camqp_read_header */
 
+/* Acknowledges the messages received so far with a single "multiple" ack,
+ * once half of the prefetch window is used up or no more data is waiting to
+ * be processed. */
+static void camqp_ack(camqp_config_t *conf) /* {{{ */
+{
+  if (conf->unacked == 0)
+    return;
+
+  if ((conf->unacked < (conf->prefetch + 1) / 2) &&
+      (amqp_frames_enqueued(conf->connection) ||
+       amqp_data_in_buffer(conf->connection)))
+    return;
+
+  int status = amqp_basic_ack(conf->connection, CAMQP_CHANNEL,
+                              conf->unacked_tag, /* multiple = */ 1);
+  if (status != 0) {
+    ERROR("amqp plugin: amqp_basic_ack failed with status %i.", status);
+    camqp_close_connection(conf);
+    return;
+  }
+
+  conf->unacked = 0;
+} /* }}} void camqp_ack */
+
 static void *camqp_subscribe_thread(void *user_data) /* {{{ */
 {
   camqp_config_t *conf = user_data;
@@ -708,12 +866,26 @@ static void *camqp_subscribe_thread(void *user_data) /* {{{ */
       continue;
     }
 
+    amqp_basic_deliver_t *deliver = frame.payload.method.decoded;
+    uint64_t delivery_tag = deliver->delivery_tag;
+
     camqp_read_header(conf);
 
+    /* camqp_read_header() closes the connection on I/O errors */
+    if (conf->connection == NULL)
+      continue;
+
+    if (conf->prefetch > 0) {
+      conf->unacked++;
+      conf->unacked_tag = delivery_tag;
+      camqp_ack(conf);
+      if (conf->connection == NULL)
+        continue;
+    }
+
     amqp_maybe_release_buffers(conf->connection);
   } /* while (subscriber_threads_running) */
 
-  camqp_config_free(conf);
   pthread_exit(NULL);
   return NULL;
 } /* }}} void *camqp_subscribe_thread */
@@ -721,27 +893,53 @@ static void *camqp_subscribe_thread(void *user_data) /* {{{ */
 static int camqp_subscribe_init(camqp_config_t *conf) /* {{{ */
 {
   int status;
-  pthread_t *tmp;
+  camqp_subscriber_t *tmp;
 
-  tmp = realloc(subscriber_threads,
-                sizeof(*subscriber_threads) * (subscriber_threads_num + 1));
+  tmp = realloc(subscribers,
+                sizeof(*subscribers) * (subscribers_num + conf->threads_num));
   if (tmp == NULL) {
     ERROR("amqp plugin: realloc failed.");
-    sfree(subscriber_threads);
     return ENOMEM;
   }
-  subscriber_threads = tmp;
-  tmp = subscriber_threads + subscriber_threads_num;
-  memset(tmp, 0, sizeof(*tmp));
+  subscribers = tmp;
+
+  /* AMQP connections must not be shared between threads, so every thread
+   * but the first gets a copy of the configuration with its own
+   * connection. The broker distributes the messages of the queue between
+   * the consumers. */
+  for (size_t i = 0; i < conf->threads_num; i++) {
+    camqp_config_t *c = conf;
+
+    if (i > 0) {
+      c = malloc(sizeof(*c));
+      if (c == NULL) {
+        /* carry on with the threads started already */
+        ERROR("amqp plugin: malloc failed.");
+        return 0;
+      }
+      memcpy(c, conf, sizeof(*c));
+      c->connection = NULL;
+      c->shared = true;
+      pthread_mutex_init(&c->lock, /* attr = */ NULL);
+    }
 
-  status =
-      plugin_thread_create(tmp, camqp_subscribe_thread, conf, "amqp subscribe");
-  if (status != 0) {
-    ERROR("amqp plugin: pthread_create failed: %s", STRERROR(status));
-    return status;
-  }
+    tmp = subscribers + subscribers_num;
+    memset(tmp, 0, sizeof(*tmp));
+    tmp->conf = c;
+
+    status = plugin_thread_create(&tmp->thread, camqp_subscribe_thread, c,
+                                  "amqp subscribe");
+    if (status != 0) {
+      ERROR("amqp plugin: pthread_create failed: %s", STRERROR(status));
+      if (i == 0)
+        return status;
+      /* the original is owned by the threads started already */
+      camqp_config_free(c);
+      return 0;
+    }
 
-  subscriber_threads_num++;
+    subscribers_num++;
+  }
 
   return 0;
 } /* }}} int camqp_subscribe_init */
@@ -749,15 +947,156 @@ static int camqp_subscribe_init(camqp_config_t *conf) /* {{{ */
 /*
  * Publishing code
  */
+#if CAMQP_HAVE_CONFIRMS
+static void camqp_confirm_handle(camqp_config_t *conf, /* {{{ */
+                                 uint64_t delivery_tag, bool multiple,
+                                 bool ack) {
+  uint64_t last = conf->confirm_next - 1;
+  uint64_t nacked = 0;
+
+  /* "multiple" with a tag of zero refers to all outstanding messages. */
+  if (multiple && (delivery_tag == 0))
+    delivery_tag = last;
+
+  if ((delivery_tag < conf->confirm_first) || (delivery_tag > last))
+    return;
+
+  for (uint64_t tag = multiple ? conf->confirm_first : delivery_tag;
+       tag <= delivery_tag; tag++) {
+    bool *pending = conf->confirm_pending + (tag % conf->confirm_max);
+    if (*pending && !ack)
+      nacked++;
+    *pending = false;
+  }
+
+  while ((conf->confirm_first < conf->confirm_next) &&
+         !conf->confirm_pending[conf->confirm_first % conf->confirm_max])
+    conf->confirm_first++;
+
+  if (nacked > 0)
+    ERROR("amqp plugin: The broker rejected %" PRIu64 " messages.", nacked);
+} /* }}} void camqp_confirm_handle */
+
+/* Reads one frame from the publishing connection, waiting up to "timeout" for
+ * it. Returns EAGAIN if no frame arrived in time. */
+static int camqp_confirm_read(camqp_config_t *conf, /* {{{ */
+                              cdtime_t timeout) {
+  struct timeval tv = CDTIME_T_TO_TIMEVAL(timeout);
+  amqp_frame_t frame;
+
+  int status = amqp_simple_wait_frame_noblock(conf->connection, &frame, &tv);
+  if (status == AMQP_STATUS_TIMEOUT)
+    return EAGAIN;
+  if (status != AMQP_STATUS_OK) {
+    ERROR("amqp plugin: amqp_simple_wait_frame_noblock failed: %s",
+          amqp_error_string2(status));
+    camqp_close_connection(conf);
+    return -1;
+  }
+
+  if (frame.frame_type != AMQP_FRAME_METHOD)
+    return 0;
+
+  switch (frame.payload.method.id) {
+  case AMQP_BASIC_ACK_METHOD: {
+    amqp_basic_ack_t *m = frame.payload.method.decoded;
+    camqp_confirm_handle(conf, m->delivery_tag, m->multiple, /* ack = */ true);
+    break;
+  }
+  case AMQP_BASIC_NACK_METHOD: {
+    amqp_basic_nack_t *m = frame.payload.method.decoded;
+    camqp_confirm_handle(conf, m->delivery_tag, m->multiple, /* ack = */ false);
+    break;
+  }
+  case AMQP_CHANNEL_CLOSE_METHOD:
+  case AMQP_CONNECTION_CLOSE_METHOD: {
+    /* amqp_channel_close_t and amqp_connection_close_t start alike */
+    amqp_channel_close_t *m = frame.payload.method.decoded;
+    char *tmp = camqp_bytes_cstring(&m->reply_text);
+    ERROR("amqp plugin: The broker closed the %s: %d %s",
+          (frame.payload.method.id == AMQP_CHANNEL_CLOSE_METHOD) ? "channel"
+                                                                 : "connection",
+          m->reply_code, (tmp != NULL) ? tmp : "");
+    sfree(tmp);
+    camqp_close_connection(conf);
+    return -1;
+  }
+  default:
+    DEBUG("amqp plugin: Unexpected method id: %#" PRIx32,
+          frame.payload.method.id);
+  }
+
+  amqp_maybe_release_buffers(conf->connection);
+  return 0;
+} /* }}} int camqp_confirm_read */
+
+/* Processes the confirms which have arrived and waits for more while more
+ * than "limit" messages are unconfirmed. */
+static int camqp_confirm_wait(camqp_config_t *conf, uint64_t limit) /* {{{ */
+{
+  cdtime_t deadline = cdtime() + conf->confirm_timeout;
+
+  while (conf->connection != NULL) {
+    cdtime_t timeout = 0;
+
+    if ((conf->confirm_next - conf->confirm_first) > limit) {
+      cdtime_t now = cdtime();
+      if (now >= deadline) {
+        ERROR("amqp plugin: The broker has not confirmed %" PRIu64
+              " messages within %.3f seconds.",
+              conf->confirm_next - conf->confirm_first,
+              CDTIME_T_TO_DOUBLE(conf->confirm_timeout));
+        camqp_close_connection(conf);
+        return -1;
+      }
+      timeout = deadline - now;
+    }
+
+    int status = camqp_confirm_read(conf, timeout);
+    if ((status == EAGAIN) && (timeout == 0))
+      return 0;
+    else if ((status != 0) && (status != EAGAIN))
+      return status;
+  }
+
+  return -1;
+} /* }}} int camqp_confirm_wait */
+
+static int camqp_flush(__attribute__((unused)) cdtime_t timeout, /* {{{ */
+                       __attribute__((unused)) const char *identifier,
+                       user_data_t *user_data) {
+  camqp_config_t *conf = user_data->data;
+  int status = 0;
+
+  pthread_mutex_lock(&conf->lock);
+  if (conf->connection != NULL)
+    status = camqp_confirm_wait(conf, /* limit = */ 0);
+  pthread_mutex_unlock(&conf->lock);
+
+  return status;
+} /* }}} int camqp_flush */
+#endif /* CAMQP_HAVE_CONFIRMS */
+
 /* XXX: You must hold "conf->lock" when calling this function! */
 static int camqp_write_locked(camqp_config_t *conf, /* {{{ */
-                              const char *buffer, const char *routing_key) {
+                              const char *buffer, size_t buffer_len,
+                              const char *routing_key) {
   int status;
 
   status = camqp_connect(conf);
   if (status != 0)
     return status;
 
+#if CAMQP_HAVE_CONFIRMS
+  /* Publishing doesn't wait for each message to be confirmed, only for a
+   * slot in the window of unconfirmed messages. */
+  if (conf->confirm) {
+    status = camqp_confirm_wait(conf, conf->confirm_max - 1);
+    if (status != 0)
+      return status;
+  }
+#endif
+
   amqp_basic_properties_t props = {._flags = AMQP_BASIC_CONTENT_TYPE_FLAG |
                                              AMQP_BASIC_DELIVERY_MODE_FLAG |
                                              AMQP_BASIC_APP_ID_FLAG,
@@ -778,41 +1117,50 @@ static int camqp_write_locked(camqp_config_t *conf, /* {{{ */
       /* channel = */ 1, amqp_cstring_bytes(CONF(conf, exchange)),
       amqp_cstring_bytes(routing_key),
       /* mandatory = */ 0,
-      /* immediate = */ 0, &props, amqp_cstring_bytes(buffer));
+      /* immediate = */ 0, &props,
+      (amqp_bytes_t){.len = buffer_len, .bytes = (void *)buffer});
   if (status != 0) {
     ERROR("amqp plugin: amqp_basic_publish failed with status %i.", status);
     camqp_close_connection(conf);
+    return status;
   }
 
-  return status;
+#if CAMQP_HAVE_CONFIRMS
+  if (conf->confirm) {
+    conf->confirm_pending[conf->confirm_next % conf->confirm_max] = true;
+    conf->confirm_next++;
+  }
+#endif
+
+  return 0;
 } /* }}} int camqp_write_locked */
 
-static int camqp_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
-                       user_data_t *user_data) {
-  camqp_config_t *conf = user_data->data;
-  char routing_key[6 * DATA_MAX_NAME_LEN];
-  char buffer[8192];
-  int status;
+static void camqp_routing_key(camqp_config_t *conf, /* {{{ */
+                              const value_list_t *vl, char *buffer,
+                              size_t buffer_size) {
+  if (conf->routing_key != NULL) {
+    sstrncpy(buffer, conf->routing_key, buffer_size);
+    return;
+  }
 
-  if ((ds == NULL) || (vl == NULL) || (conf == NULL))
-    return EINVAL;
+  ssnprintf(buffer, buffer_size, "collectd/%s/%s/%s/%s/%s", vl->host,
+            vl->plugin, vl->plugin_instance, vl->type, vl->type_instance);
 
-  if (conf->routing_key != NULL) {
-    sstrncpy(routing_key, conf->routing_key, sizeof(routing_key));
-  } else {
-    ssnprintf(routing_key, sizeof(routing_key), "collectd/%s/%s/%s/%s/%s",
-              vl->host, vl->plugin, vl->plugin_instance, vl->type,
-              vl->type_instance);
-
-    /* Switch slashes (the only character forbidden by collectd) and dots
-     * (the separation character used by AMQP). */
-    for (size_t i = 0; routing_key[i] != 0; i++) {
-      if (routing_key[i] == '.')
-        routing_key[i] = '/';
-      else if (routing_key[i] == '/')
-        routing_key[i] = '.';
-    }
+  /* Switch slashes (the only character forbidden by collectd) and dots
+   * (the separation character used by AMQP). */
+  for (size_t i = 0; buffer[i] != 0; i++) {
+    if (buffer[i] == '.')
+      buffer[i] = '/';
+    else if (buffer[i] == '/')
+      buffer[i] = '.';
   }
+} /* }}} void camqp_routing_key */
+
+/* Appends "vl" to the message in "buf". */
+static int camqp_format(camqp_config_t *conf, strbuf_t *buf, /* {{{ */
+                        const data_set_t *ds, const value_list_t *vl) {
+  char buffer[8192];
+  int status;
 
   if (conf->format == CAMQP_FORMAT_COMMAND) {
     status = cmd_create_putval(buffer, sizeof(buffer), ds, vl);
@@ -820,13 +1168,13 @@ static int camqp_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
       ERROR("amqp plugin: cmd_create_putval failed with status %i.", status);
       return status;
     }
+    /* one command per line */
+    if (buf->pos > 0)
+      status = strbuf_print(buf, "\n");
+    if (status == 0)
+      status = strbuf_print(buf, buffer);
   } else if (conf->format == CAMQP_FORMAT_JSON) {
-    size_t bfree = sizeof(buffer);
-    size_t bfill = 0;
-
-    format_json_initialize(buffer, &bfill, &bfree);
-    format_json_value_list(buffer, &bfill, &bfree, ds, vl, conf->store_rates);
-    format_json_finalize(buffer, &bfill, &bfree);
+    status = format_json_value_list_strbuf(buf, ds, vl, conf->store_rates);
   } else if (conf->format == CAMQP_FORMAT_GRAPHITE) {
     status =
         format_graphite(buffer, sizeof(buffer), ds, vl, conf->prefix,
@@ -835,18 +1183,97 @@ static int camqp_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
       ERROR("amqp plugin: format_graphite failed with status %i.", status);
       return status;
     }
+    status = strbuf_print(buf, buffer);
   } else {
     ERROR("amqp plugin: Invalid format (%i).", conf->format);
     return -1;
   }
 
+  if (status != 0)
+    ERROR("amqp plugin: Formatting the message failed with status %i.",
+          status);
+  return status;
+} /* }}} int camqp_format */
+
+/* XXX: You must hold "conf->lock" when calling this function! */
+static int camqp_send_locked(camqp_config_t *conf, /* {{{ */
+                             strbuf_t *buf, const char *routing_key) {
+  if (conf->format == CAMQP_FORMAT_JSON) {
+    int status = format_json_finalize_strbuf(buf);
+    if (status != 0) {
+      ERROR("amqp plugin: format_json_finalize_strbuf failed with status %i.",
+            status);
+      return status;
+    }
+  }
+
+  return camqp_write_locked(conf, buf->ptr, buf->pos, routing_key);
+} /* }}} int camqp_send_locked */
+
+static int camqp_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
+                       user_data_t *user_data) {
+  camqp_config_t *conf = user_data->data;
+  char routing_key[6 * DATA_MAX_NAME_LEN];
+  char buffer[8192];
+  strbuf_t buf = STRBUF_CREATE_FIXED(buffer, sizeof(buffer));
+  int status;
+
+  if ((ds == NULL) || (vl == NULL) || (conf == NULL))
+    return EINVAL;
+
+  camqp_routing_key(conf, vl, routing_key, sizeof(routing_key));
+
+  status = camqp_format(conf, &buf, ds, vl);
+  if (status != 0)
+    return status;
+
   pthread_mutex_lock(&conf->lock);
-  status = camqp_write_locked(conf, buffer, routing_key);
+  status = camqp_send_locked(conf, &buf, routing_key);
   pthread_mutex_unlock(&conf->lock);
 
   return status;
 } /* }}} int camqp_write */
 
+/* Sends consecutive value lists with the same routing key in one message. */
+static int camqp_write_batch(write_batch_entry_t const *entries, /* {{{ */
+                             size_t entries_num, user_data_t *user_data) {
+  camqp_config_t *conf = user_data->data;
+  char routing_key[6 * DATA_MAX_NAME_LEN];
+  char batch_key[6 * DATA_MAX_NAME_LEN] = "";
+  int status = 0;
+
+  pthread_mutex_lock(&conf->lock);
+  strbuf_reset(&conf->batch);
+
+  for (size_t i = 0; i < entries_num; i++) {
+    int tmp;
+
+    camqp_routing_key(conf, entries[i].vl, routing_key, sizeof(routing_key));
+    if ((conf->batch.pos > 0) && (strcmp(routing_key, batch_key) != 0)) {
+      tmp = camqp_send_locked(conf, &conf->batch, batch_key);
+      if (tmp != 0)
+        status = tmp;
+      strbuf_reset(&conf->batch);
+    }
+
+    tmp = camqp_format(conf, &conf->batch, entries[i].ds, entries[i].vl);
+    if (tmp != 0) {
+      status = tmp;
+      continue;
+    }
+    sstrncpy(batch_key, routing_key, sizeof(batch_key));
+  }
+
+  if (conf->batch.pos > 0) {
+    int tmp = camqp_send_locked(conf, &conf->batch, batch_key);
+    if (tmp != 0)
+      status = tmp;
+  }
+
+  pthread_mutex_unlock(&conf->lock);
+  return status;
+} /* }}} int camqp_write_batch */
+
 /*
  * Config handling
  */
@@ -906,6 +1333,7 @@ static int camqp_config_connection(oconfig_item_t *ci, /* {{{ */
   conf->exchange = NULL;
   conf->routing_key = NULL;
   conf->connection_retry_delay = 0;
+  conf->last_connect_time = 0;
 
   /* publish only */
   conf->delivery_mode = CAMQP_DM_VOLATILE;
@@ -915,11 +1343,23 @@ static int camqp_config_connection(oconfig_item_t *ci, /* {{{ */
   conf->prefix = NULL;
   conf->postfix = NULL;
   conf->escape_char = '_';
+  /* publish & batching only */
+  conf->batch_size = 1;
+  conf->batch_timeout = 0;
+  conf->batch = STRBUF_CREATE;
+  /* publish & publisher confirms only */
+  conf->confirm = false;
+  conf->confirm_max = CAMQP_DEFAULT_MAX_UNCONFIRMED;
+  conf->confirm_timeout = CAMQP_DEFAULT_CONFIRM_TIMEOUT;
+  conf->confirm_pending = NULL;
   /* subscribe only */
   conf->exchange_type = NULL;
   conf->queue = NULL;
   conf->queue_durable = false;
   conf->queue_auto_delete = true;
+  conf->threads_num = 1;
+  conf->prefetch = 0;
+  conf->shared = false;
   /* general */
   conf->connection = NULL;
   pthread_mutex_init(&conf->lock, /* attr = */ NULL);
@@ -1021,6 +1461,45 @@ static int camqp_config_connection(oconfig_item_t *ci, /* {{{ */
                 "only one character. Others will be ignored.");
       conf->escape_char = tmp_buff[0];
       sfree(tmp_buff);
+    } else if ((strcasecmp("BatchSize", child->key) == 0) && publish) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp < 1)) {
+        ERROR("amqp plugin: \"BatchSize\" must be positive.");
+        status = EINVAL;
+      } else if (status == 0)
+        conf->batch_size = (size_t)tmp;
+    } else if ((strcasecmp("BatchTimeout", child->key) == 0) && publish)
+      status = cf_util_get_cdtime(child, &conf->batch_timeout);
+    else if ((strcasecmp("PublisherConfirms", child->key) == 0) && publish)
+      status = cf_util_get_boolean(child, &conf->confirm);
+    else if ((strcasecmp("MaxUnconfirmed", child->key) == 0) && publish) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp < 1)) {
+        ERROR("amqp plugin: \"MaxUnconfirmed\" must be positive.");
+        status = EINVAL;
+      } else if (status == 0)
+        conf->confirm_max = (size_t)tmp;
+    } else if ((strcasecmp("ConfirmTimeout", child->key) == 0) && publish)
+      status = cf_util_get_cdtime(child, &conf->confirm_timeout);
+    else if ((strcasecmp("Threads", child->key) == 0) && !publish) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp < 1)) {
+        ERROR("amqp plugin: \"Threads\" must be positive.");
+        status = EINVAL;
+      } else if (status == 0)
+        conf->threads_num = (size_t)tmp;
+    } else if ((strcasecmp("Prefetch", child->key) == 0) && !publish) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && ((tmp < 0) || (tmp > UINT16_MAX))) {
+        ERROR("amqp plugin: \"Prefetch\" must be between 0 and %d.",
+              UINT16_MAX);
+        status = EINVAL;
+      } else if (status == 0)
+        conf->prefetch = (uint16_t)tmp;
     } else if (strcasecmp("ConnectionRetryDelay", child->key) == 0)
       status = cf_util_get_int(child, &conf->connection_retry_delay);
     else
@@ -1062,6 +1541,25 @@ static int camqp_config_connection(oconfig_item_t *ci, /* {{{ */
     status = 1;
   }
 #endif
+  if ((status == 0) && conf->confirm) {
+#if CAMQP_HAVE_CONFIRMS
+    conf->confirm_pending =
+        calloc(conf->confirm_max, sizeof(*conf->confirm_pending));
+    if (conf->confirm_pending == NULL) {
+      ERROR("amqp plugin: calloc failed.");
+      status = ENOMEM;
+    }
+#else
+    ERROR("amqp plugin: PublisherConfirms is set but not supported. "
+          "rebuild collectd with rabbitmq-c >= 0.4");
+    status = 1;
+#endif
+  }
+  /* Each thread would declare a queue of its own, receiving all messages. */
+  if ((status == 0) && (conf->threads_num > 1) && (conf->queue == NULL)) {
+    ERROR("amqp plugin: \"Threads\" requires the \"Queue\" option.");
+    status = 1;
+  }
   if (status == 0 &&
       (conf->tls_client_cert != NULL || conf->tls_client_key != NULL)) {
     if (conf->tls_client_cert == NULL || conf->tls_client_key == NULL) {
@@ -1085,15 +1583,28 @@ static int camqp_config_connection(oconfig_item_t *ci, /* {{{ */
     char cbname[128];
     ssnprintf(cbname, sizeof(cbname), "amqp/%s", conf->name);
 
-    status = plugin_register_write(cbname, camqp_write,
-                                   &(user_data_t){
-                                       .data = conf,
-                                       .free_func = camqp_config_free,
-                                   });
+    user_data_t user_data = {
+        .data = conf,
+        .free_func = camqp_config_free,
+    };
+
+    if (conf->batch_size > 1)
+      status = plugin_register_write_batch(cbname, camqp_write_batch,
+                                           conf->batch_size,
+                                           conf->batch_timeout, &user_data);
+    else
+      status = plugin_register_write(cbname, camqp_write, &user_data);
     if (status != 0) {
       camqp_config_free(conf);
       return status;
     }
+    user_data.free_func = NULL;
+
+#if CAMQP_HAVE_CONFIRMS
+    /* flushing waits for the broker to confirm all messages */
+    if (conf->confirm)
+      plugin_register_flush(cbname, camqp_flush, &user_data);
+#endif
   } else {
     status = camqp_subscribe_init(conf);
     if (status != 0) {
@@ -32,6 +32,7 @@
 #include "utils/deq/deq.h"
 #include "utils/format_graphite/format_graphite.h"
 #include "utils/format_json/format_json.h"
+#include "utils/strbuf/strbuf.h"
 #include "utils_random.h"
 
 #include <proton/condition.h>
@@ -53,6 +54,8 @@
 #define AMQP1_FORMAT_JSON 0
 #define AMQP1_FORMAT_COMMAND 1
 #define AMQP1_FORMAT_GRAPHITE 2
+/* Maximum number of unused messages kept for reuse. */
+#define AMQP1_POOL_SIZE 256
 
 typedef struct amqp1_config_transport_s {
   DEQ_LINKS(struct amqp1_config_transport_s);
@@ -77,14 +80,21 @@ typedef struct amqp1_config_instance_s {
   char *postfix;
   char escape_char;
   bool pre_settle;
+  size_t batch_size;
+  cdtime_t batch_timeout;
   char send_to[1024];
 } amqp1_config_instance_t;
 
 DEQ_DECLARE(amqp1_config_instance_t, amqp1_config_instance_list_t);
 
+/* Messages are reused, see cd_message_alloc(), so the buffers and the proton
+ * message keep their memory. */
 typedef struct cd_message_s {
   DEQ_LINKS(struct cd_message_s);
-  pn_rwbytes_t mbuf;
+  strbuf_t body;
+  pn_message_t *message;
+  pn_rwbytes_t mbuf; /* encoded message; "size" is its length */
+  size_t mbuf_size;  /* allocated size of "mbuf.start" */
   amqp1_config_instance_t *instance;
 } cd_message_t;
 
@@ -98,6 +108,12 @@ static pn_link_t *sender;
 static pn_proactor_t *proactor;
 static pthread_mutex_t send_lock;
 static cd_message_list_t out_messages;
+static cd_message_list_t free_messages;
+/* Set while a wakeup of the event thread is pending or the link has run out
+ * of credit; no need to wake it up for new messages then. Protected by
+ * "send_lock". */
+static bool wake_pending;
+static bool link_blocked;
 static uint64_t cd_tag = 1;
 static uint64_t acknowledged;
 static amqp1_config_transport_t *transport;
@@ -109,10 +125,63 @@ static pthread_t event_thread_id;
  * Functions
  */
 static void cd_message_free(cd_message_t *cdm) {
+  STRBUF_DESTROY(cdm->body);
+  if (cdm->message != NULL)
+    pn_message_free(cdm->message);
   free(cdm->mbuf.start);
   free(cdm);
 } /* }}} void cd_message_free */
 
+/* must hold send_lock when calling */
+static void cd_message_release_locked(cd_message_t *cdm) /* {{{ */
+{
+  if (DEQ_SIZE(free_messages) >= AMQP1_POOL_SIZE) {
+    cd_message_free(cdm);
+    return;
+  }
+
+  DEQ_INSERT_TAIL(free_messages, cdm);
+} /* }}} void cd_message_release_locked */
+
+static void cd_message_release(cd_message_t *cdm) /* {{{ */
+{
+  pthread_mutex_lock(&send_lock);
+  cd_message_release_locked(cdm);
+  pthread_mutex_unlock(&send_lock);
+} /* }}} void cd_message_release */
+
+/* Returns an empty message, reusing one from the pool if possible. */
+static cd_message_t *
+cd_message_alloc(amqp1_config_instance_t *instance) /* {{{ */
+{
+  pthread_mutex_lock(&send_lock);
+  cd_message_t *cdm = DEQ_HEAD(free_messages);
+  if (cdm != NULL)
+    DEQ_REMOVE_HEAD(free_messages);
+  pthread_mutex_unlock(&send_lock);
+
+  if (cdm == NULL) {
+    cdm = calloc(1, sizeof(*cdm));
+    if (cdm == NULL) {
+      ERROR("amqp1 plugin: calloc failed.");
+      return NULL;
+    }
+    cdm->body = STRBUF_CREATE;
+    cdm->message = pn_message();
+    if (cdm->message == NULL) {
+      ERROR("amqp1 plugin: pn_message failed.");
+      cd_message_free(cdm);
+      return NULL;
+    }
+  }
+
+  DEQ_ITEM_INIT(cdm);
+  strbuf_reset(&cdm->body);
+  cdm->mbuf.size = 0;
+  cdm->instance = instance;
+  return cdm;
+} /* }}} cd_message_t *cd_message_alloc */
+
 static int amqp1_send_out_messages(pn_link_t *link) /* {{{ */
 {
   uint64_t dtag;
@@ -130,8 +199,9 @@ static int amqp1_send_out_messages(pn_link_t *link) /* {{{ */
 
   pthread_mutex_lock(&send_lock);
 
+  /* Take at most as many messages as the peer is willing to accept. */
+  dtag = cd_tag;
   if (link_credit > 0) {
-    dtag = cd_tag;
     cdm = DEQ_HEAD(out_messages);
     while (cdm) {
       DEQ_REMOVE_HEAD(out_messages);
@@ -143,12 +213,15 @@ static int amqp1_send_out_messages(pn_link_t *link) /* {{{ */
     cd_tag += DEQ_SIZE(to_send);
   }
 
+  /* Messages left over wait for the next PN_LINK_FLOW event. */
+  wake_pending = false;
+  link_blocked = (DEQ_SIZE(out_messages) > 0);
+
   pthread_mutex_unlock(&send_lock);
 
   /* message is already formatted and encoded */
   cdm = DEQ_HEAD(to_send);
   while (cdm) {
-    DEQ_REMOVE_HEAD(to_send);
     dtag++;
     dlv = pn_delivery(link, pn_dtag((const char *)&dtag, sizeof(dtag)));
     pn_link_send(link, cdm->mbuf.start, cdm->mbuf.size);
@@ -157,8 +230,17 @@ static int amqp1_send_out_messages(pn_link_t *link) /* {{{ */
       pn_delivery_settle(dlv);
     }
     event_count++;
-    cd_message_free(cdm);
-    cdm = DEQ_HEAD(to_send);
+    cdm = DEQ_NEXT(cdm);
+  }
+
+  /* return the messages to the pool */
+  if (DEQ_SIZE(to_send) > 0) {
+    pthread_mutex_lock(&send_lock);
+    while ((cdm = DEQ_HEAD(to_send)) != NULL) {
+      DEQ_REMOVE_HEAD(to_send);
+      cd_message_release_locked(cdm);
+    }
+    pthread_mutex_unlock(&send_lock);
   }
 
   return event_count;
@@ -181,6 +263,10 @@ static bool handle(pn_event_t *event) /* {{{ */
 
   case PN_CONNECTION_INIT: {
     conn = pn_event_connection(event);
+    pthread_mutex_lock(&send_lock);
+    wake_pending = false;
+    link_blocked = false;
+    pthread_mutex_unlock(&send_lock);
     pn_connection_set_container(conn, transport->name);
     pn_connection_open(conn);
     pn_session_t *ssn = pn_session(conn);
@@ -292,13 +378,21 @@ static void *event_thread(void __attribute__((unused)) * arg) /* {{{ */
 
   pn_proactor_disconnect(proactor, NULL);
 
-  /* Free the remaining out_messages */
+  /* Free the remaining out_messages and the pool */
+  pthread_mutex_lock(&send_lock);
   cdm = DEQ_HEAD(out_messages);
   while (cdm) {
     DEQ_REMOVE_HEAD(out_messages);
     cd_message_free(cdm);
     cdm = DEQ_HEAD(out_messages);
   }
+  cdm = DEQ_HEAD(free_messages);
+  while (cdm) {
+    DEQ_REMOVE_HEAD(free_messages);
+    cd_message_free(cdm);
+    cdm = DEQ_HEAD(free_messages);
+  }
+  pthread_mutex_unlock(&send_lock);
 
   event_thread_running = false;
 
@@ -309,35 +403,43 @@ static int encqueue(cd_message_t *cdm,
                     amqp1_config_instance_t *instance) /* {{{ */
 {
   /* encode message */
-  pn_message_t *message = pn_message();
+  pn_message_t *message = cdm->message;
+  pn_message_clear(message);
   pn_message_set_address(message, instance->send_to);
   pn_data_t *body = pn_message_body(message);
   pn_data_clear(body);
-  pn_data_put_binary(body, pn_bytes(cdm->mbuf.size, cdm->mbuf.start));
+  pn_data_put_binary(body, pn_bytes(cdm->body.pos, cdm->body.ptr));
   pn_data_exit(body);
 
-  /* put_binary copies and stores so ok to use mbuf */
-  cdm->mbuf.size = BUFSIZE;
+  if (cdm->mbuf_size == 0) {
+    cdm->mbuf.start = malloc(BUFSIZE);
+    if (cdm->mbuf.start == NULL) {
+      ERROR("amqp1 plugin: malloc failed.");
+      return -1;
+    }
+    cdm->mbuf_size = BUFSIZE;
+  }
 
   int status;
   char *start;
+  cdm->mbuf.size = cdm->mbuf_size;
   while ((status = pn_message_encode(message, cdm->mbuf.start,
                                      &cdm->mbuf.size)) == PN_OVERFLOW) {
-    DEBUG("amqp1 plugin: increasing message buffer size %zu", cdm->mbuf.size);
-    cdm->mbuf.size *= 2;
-    start = realloc(cdm->mbuf.start, cdm->mbuf.size);
+    DEBUG("amqp1 plugin: increasing message buffer size %zu", cdm->mbuf_size);
+    start = realloc(cdm->mbuf.start, 2 * cdm->mbuf_size);
     if (start == NULL) {
       status = -1;
       break;
     } else {
       cdm->mbuf.start = start;
+      cdm->mbuf_size *= 2;
+      cdm->mbuf.size = cdm->mbuf_size;
     }
   }
 
   if (status != 0) {
     ERROR("amqp1 plugin: error encoding message: %s",
           pn_error_text(pn_message_error(message)));
-    pn_message_free(message);
     return -1;
   }
 
@@ -349,15 +451,19 @@ static int encqueue(cd_message_t *cdm,
     DEBUG("amqp1 plugin: dropping oldest message because sendq is full");
     evict = DEQ_HEAD(out_messages);
     DEQ_REMOVE_HEAD(out_messages);
-    cd_message_free(evict);
+    cd_message_release_locked(evict);
   }
   DEQ_INSERT_TAIL(out_messages, cdm);
-  pthread_mutex_unlock(&send_lock);
 
-  pn_message_free(message);
+  /* The event thread sends as long as the link has credit, so only wake it
+   * up if it is idle. */
+  bool wake = !wake_pending && !link_blocked;
+  if (wake)
+    wake_pending = true;
+  pthread_mutex_unlock(&send_lock);
 
   /* activate the sender */
-  if (conn) {
+  if (wake && conn) {
     pn_connection_wake(conn);
   }
 
@@ -367,10 +473,8 @@ static int encqueue(cd_message_t *cdm,
 static int amqp1_notify(notification_t const *n,
                         user_data_t *user_data) /* {{{ */
 {
+  char buffer[BUFSIZE];
   int status = 0;
-  size_t bfree = BUFSIZE;
-  size_t bfill = 0;
-  size_t bufsize = BUFSIZE;
 
   if (n == NULL || user_data == NULL)
     return EINVAL;
@@ -381,42 +485,28 @@ static int amqp1_notify(notification_t const *n,
     ERROR("amqp1 plugin: write notification failed");
   }
 
-  cd_message_t *cdm = malloc(sizeof(*cdm));
-  if (cdm == NULL) {
-    ERROR("amqp1 plugin: notify failed");
-    return -1;
-  }
-
-  DEQ_ITEM_INIT(cdm);
-  char *start = malloc(bufsize);
-  if (start == NULL) {
-    ERROR("amqp1 plugin: malloc failed");
-    free(cdm);
-    return -1;
-  }
-  cdm->mbuf.size = bufsize;
-  cdm->mbuf.start = start;
-  cdm->instance = instance;
-
   switch (instance->format) {
   case AMQP1_FORMAT_JSON:
-    format_json_initialize(cdm->mbuf.start, &bfill, &bfree);
-    status = format_json_notification(cdm->mbuf.start, bufsize, n);
+    status = format_json_notification(buffer, sizeof(buffer), n);
     if (status != 0) {
       ERROR("amqp1 plugin: formatting notification failed");
-      cd_message_free(cdm);
       return status;
     }
-    cdm->mbuf.size = strlen(cdm->mbuf.start);
-    if (cdm->mbuf.size >= BUFSIZE) {
-      ERROR("amqp1 plugin: notify format json failed");
-      cd_message_free(cdm);
-      return -1;
-    }
     break;
   default:
     ERROR("amqp1 plugin: Invalid notify format (%i).", instance->format);
-    cd_message_free(cdm);
+    return -1;
+  }
+
+  cd_message_t *cdm = cd_message_alloc(instance);
+  if (cdm == NULL) {
+    ERROR("amqp1 plugin: notify failed");
+    return -1;
+  }
+
+  if (strbuf_print(&cdm->body, buffer) != 0) {
+    ERROR("amqp1 plugin: notify failed");
+    cd_message_release(cdm);
     return -1;
   }
 
@@ -424,109 +514,132 @@ static int amqp1_notify(notification_t const *n,
   status = encqueue(cdm, instance);
   if (status != 0) {
     ERROR("amqp1 plugin: notify enqueue failed");
-    cd_message_free(cdm);
+    cd_message_release(cdm);
   }
   return status;
 
 } /* }}} int amqp1_notify */
 
-static int amqp1_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
-                       user_data_t *user_data) {
-  int status = 0;
-  size_t bfree = BUFSIZE;
-  size_t bfill = 0;
-  size_t bufsize = BUFSIZE;
-
-  if (ds == NULL || vl == NULL || transport == NULL || user_data == NULL)
-    return EINVAL;
-
-  amqp1_config_instance_t *instance = user_data->data;
-
-  if (instance->notify != false) {
-    ERROR("amqp1 plugin: write failed");
-  }
-
-  cd_message_t *cdm = malloc(sizeof(*cdm));
-  if (cdm == NULL) {
-    ERROR("amqp1 plugin: malloc failed.");
-    return -1;
-  }
-  DEQ_ITEM_INIT(cdm);
-  char *start = malloc(bufsize);
-  if (start == NULL) {
-    ERROR("amqp1 plugin: malloc failed.");
-    free(cdm);
-    return -1;
-  }
-  cdm->mbuf.size = bufsize;
-  cdm->mbuf.start = start;
-  cdm->instance = instance;
+/* Appends "vl" to the body of a message. */
+static int amqp1_format(amqp1_config_instance_t *instance, /* {{{ */
+                        strbuf_t *buf, const data_set_t *ds,
+                        const value_list_t *vl) {
+  char buffer[BUFSIZE];
+  int status;
 
   switch (instance->format) {
   case AMQP1_FORMAT_COMMAND:
-    status = cmd_create_putval((char *)cdm->mbuf.start, bufsize, ds, vl);
+    status = cmd_create_putval(buffer, sizeof(buffer), ds, vl);
     if (status != 0) {
       ERROR("amqp1 plugin: cmd_create_putval failed with status %i.", status);
-      cd_message_free(cdm);
       return status;
     }
-    cdm->mbuf.size = strlen(cdm->mbuf.start);
-    if (cdm->mbuf.size >= BUFSIZE) {
-      ERROR("amqp1 plugin: format cmd failed");
-      cd_message_free(cdm);
-      return -1;
-    }
+    /* one command per line */
+    if (buf->pos > 0)
+      status = strbuf_print(buf, "\n");
+    if (status == 0)
+      status = strbuf_print(buf, buffer);
     break;
   case AMQP1_FORMAT_JSON:
-    format_json_initialize((char *)cdm->mbuf.start, &bfill, &bfree);
-    format_json_value_list((char *)cdm->mbuf.start, &bfill, &bfree, ds, vl,
-                           instance->store_rates);
-    status = format_json_finalize((char *)cdm->mbuf.start, &bfill, &bfree);
-    if (status != 0) {
-      ERROR("amqp1 plugin: format_json_finalize failed with status %i.",
-            status);
-      cd_message_free(cdm);
-      return status;
-    }
-    cdm->mbuf.size = strlen(cdm->mbuf.start);
-    if (cdm->mbuf.size >= BUFSIZE) {
-      ERROR("amqp1 plugin: format json failed");
-      cd_message_free(cdm);
-      return -1;
-    }
+    status = format_json_value_list_strbuf(buf, ds, vl, instance->store_rates);
     break;
   case AMQP1_FORMAT_GRAPHITE:
-    status = format_graphite((char *)cdm->mbuf.start, bufsize, ds, vl,
-                             instance->prefix, instance->postfix,
-                             instance->escape_char, instance->graphite_flags);
+    status = format_graphite(buffer, sizeof(buffer), ds, vl, instance->prefix,
+                             instance->postfix, instance->escape_char,
+                             instance->graphite_flags);
     if (status != 0) {
       ERROR("amqp1 plugin: format_graphite failed with status %i.", status);
-      cd_message_free(cdm);
       return status;
     }
-    cdm->mbuf.size = strlen(cdm->mbuf.start);
-    if (cdm->mbuf.size >= BUFSIZE) {
-      ERROR("amqp1 plugin: format graphite failed");
-      cd_message_free(cdm);
-      return -1;
-    }
+    status = strbuf_print(buf, buffer);
     break;
   default:
     ERROR("amqp1 plugin: Invalid write format (%i).", instance->format);
-    cd_message_free(cdm);
     return -1;
   }
 
-  /* encode message and place on outbound queue */
-  status = encqueue(cdm, instance);
-  if (status != 0) {
-    ERROR("amqp1 plugin: write enqueue failed");
-    cd_message_free(cdm);
+  if (status != 0)
+    ERROR("amqp1 plugin: formatting the message failed with status %i.",
+          status);
+  return status;
+} /* }}} int amqp1_format */
+
+/* Encodes "cdm" and places it on the outbound queue. Releases "cdm" on
+ * failure. */
+static int amqp1_send(cd_message_t *cdm) /* {{{ */
+{
+  int status = 0;
+
+  if (cdm->instance->format == AMQP1_FORMAT_JSON) {
+    status = format_json_finalize_strbuf(&cdm->body);
+    if (status != 0)
+      ERROR("amqp1 plugin: format_json_finalize failed with status %i.",
+            status);
+  }
+
+  if (status == 0) {
+    status = encqueue(cdm, cdm->instance);
+    if (status != 0)
+      ERROR("amqp1 plugin: write enqueue failed");
   }
+
+  if (status != 0)
+    cd_message_release(cdm);
   return status;
+} /* }}} int amqp1_send */
+
+static int amqp1_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
+                       user_data_t *user_data) {
+  if (ds == NULL || vl == NULL || transport == NULL || user_data == NULL)
+    return EINVAL;
+
+  amqp1_config_instance_t *instance = user_data->data;
+
+  if (instance->notify != false) {
+    ERROR("amqp1 plugin: write failed");
+  }
+
+  cd_message_t *cdm = cd_message_alloc(instance);
+  if (cdm == NULL)
+    return -1;
+
+  int status = amqp1_format(instance, &cdm->body, ds, vl);
+  if (status != 0) {
+    cd_message_release(cdm);
+    return status;
+  }
 
+  return amqp1_send(cdm);
 } /* }}} int amqp1_write */
 
+/* Sends all value lists of a batch in one message. */
+static int amqp1_write_batch(write_batch_entry_t const *entries, /* {{{ */
+                             size_t entries_num, user_data_t *user_data) {
+  if (transport == NULL || user_data == NULL)
+    return EINVAL;
+
+  amqp1_config_instance_t *instance = user_data->data;
+
+  cd_message_t *cdm = cd_message_alloc(instance);
+  if (cdm == NULL)
+    return -1;
+
+  int status = 0;
+  for (size_t i = 0; i < entries_num; i++) {
+    int tmp = amqp1_format(instance, &cdm->body, entries[i].ds, entries[i].vl);
+    if (tmp != 0)
+      status = tmp;
+  }
+
+  if (cdm->body.pos == 0) {
+    cd_message_release(cdm);
+    return status;
+  }
+
+  int tmp = amqp1_send(cdm);
+  return (tmp != 0) ? tmp : status;
+} /* }}} int amqp1_write_batch */
+
 static void amqp1_config_transport_free(void *ptr) /* {{{ */
 {
   amqp1_config_transport_t *transport = ptr;
@@ -566,6 +679,8 @@ static int amqp1_config_instance(oconfig_item_t *ci) /* {{{ */
     return ENOMEM;
   }
 
+  instance->batch_size = 1;
+
   int status = cf_util_get_string(ci, &instance->name);
   if (status != 0) {
     sfree(instance);
@@ -577,6 +692,16 @@ static int amqp1_config_instance(oconfig_item_t *ci) /* {{{ */
 
     if (strcasecmp("PreSettle", child->key) == 0)
       status = cf_util_get_boolean(child, &instance->pre_settle);
+    else if (strcasecmp("BatchSize", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp < 1)) {
+        ERROR("amqp1 plugin: \"BatchSize\" must be positive.");
+        status = EINVAL;
+      } else if (status == 0)
+        instance->batch_size = (size_t)tmp;
+    } else if (strcasecmp("BatchTimeout", child->key) == 0)
+      status = cf_util_get_cdtime(child, &instance->batch_timeout);
     else if (strcasecmp("Notify", child->key) == 0)
       status = cf_util_get_boolean(child, &instance->notify);
     else if (strcasecmp("Format", child->key) == 0) {
@@ -656,6 +781,14 @@ static int amqp1_config_instance(oconfig_item_t *ci) /* {{{ */
               .data = instance,
               .free_func = amqp1_config_instance_free,
           });
+    } else if (instance->batch_size > 1) {
+      status = plugin_register_write_batch(
+          tpname, amqp1_write_batch, instance->batch_size,
+          instance->batch_timeout,
+          &(user_data_t){
+              .data = instance,
+              .free_func = amqp1_config_instance_free,
+          });
     } else {
       status =
           plugin_register_write(tpname, amqp1_write,
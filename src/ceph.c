@@ -29,6 +29,7 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 
 #include <arpa/inet.h>
@@ -118,14 +119,17 @@ struct ceph_daemon {
   uint32_t *ds_types;
   /** Track ds names to match with types */
   char **ds_names;
+  /**
+   * Maps the key path of a counter in the schema, e.g. "osd.op_r_latency",
+   * to its index in ds_types and ds_names.
+   */
+  c_avl_tree_t *ds_index;
 
   /**
    * Keep track of last data for latency values so we can calculate rate
-   * since last poll.
+   * since last poll. Has ds_num elements.
    */
-  struct last_data **last_poll_data;
-  /** index of last poll data */
-  int last_idx;
+  struct last_data *last_poll_data;
 };
 
 /******* JSON parsing *******/
@@ -174,13 +178,6 @@ struct values_tmp {
   struct ceph_daemon *d;
   /** track avgcount across counters for avgcount/sum latency pairs */
   uint64_t avgcount;
-  /** current index of counters - used to get type of counter */
-  int index;
-  /**
-   * similar to index, but current index of latency type counters -
-   * used to get last poll data of counter
-   */
-  int latency_index;
   /**
    * values list - maintain across counters since
    * host/plugin/plugin instance are always the same
@@ -193,7 +190,7 @@ struct values_tmp {
  * between this poll data and last poll data.
  */
 struct last_data {
-  char ds_name[DATA_MAX_NAME_LEN];
+  bool valid;
   double last_sum;
   uint64_t last_count;
 };
@@ -381,19 +378,29 @@ static void ceph_daemons_print(void) {
   }
 }
 
-static void ceph_daemon_free(struct ceph_daemon *d) {
-  for (int i = 0; i < d->last_idx; i++) {
-    sfree(d->last_poll_data[i]);
-  }
+/* Frees everything learned from the daemon's schema. */
+static void ceph_daemon_reset_schema(struct ceph_daemon *d) {
   sfree(d->last_poll_data);
-  d->last_poll_data = NULL;
-  d->last_idx = 0;
+
+  if (d->ds_index != NULL) {
+    void *key;
+    void *value;
+    while (c_avl_pick(d->ds_index, &key, &value) == 0)
+      sfree(key);
+    c_avl_destroy(d->ds_index);
+    d->ds_index = NULL;
+  }
 
   for (int i = 0; i < d->ds_num; i++) {
     sfree(d->ds_names[i]);
   }
   sfree(d->ds_types);
   sfree(d->ds_names);
+  d->ds_num = 0;
+}
+
+static void ceph_daemon_free(struct ceph_daemon *d) {
+  ceph_daemon_reset_schema(d);
   sfree(d);
 }
 
@@ -547,6 +554,7 @@ static int ceph_daemon_add_ds_entry(struct ceph_daemon *d, const char *name,
                                     int pc_type) {
   uint32_t type;
   char ds_name[DATA_MAX_NAME_LEN];
+  char *path;
 
   if (convert_special_metrics) {
     /**
@@ -587,6 +595,24 @@ static int ceph_daemon_add_ds_entry(struct ceph_daemon *d, const char *name,
   }
 
   sstrncpy(d->ds_names[d->ds_num], ds_name, DATA_MAX_NAME_LEN - 1);
+
+  if (d->ds_index == NULL) {
+    d->ds_index = c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (d->ds_index == NULL) {
+      return -ENOMEM;
+    }
+  }
+
+  /* The data reply uses the same path without the ".type" suffix. */
+  path = malloc(strlen(name) + 1);
+  if (path == NULL) {
+    return -ENOMEM;
+  }
+  cut_suffix(path, strlen(name) + 1, name, ".type");
+  if (c_avl_insert(d->ds_index, path, (void *)(intptr_t)d->ds_num) != 0) {
+    sfree(path);
+  }
+
   d->ds_num = (d->ds_num + 1);
 
   return 0;
@@ -747,117 +773,61 @@ static int node_handler_define_schema(void *arg, const char *val,
                                       const char *key) {
   struct ceph_daemon *d = (struct ceph_daemon *)arg;
   int pc_type;
-  pc_type = atoi(val);
-  return ceph_daemon_add_ds_entry(d, key, pc_type);
-}
-
-/**
- * Latency counter does not yet have an entry in last poll data - add it.
- */
-static int add_last(struct ceph_daemon *d, const char *ds_n, double cur_sum,
-                    uint64_t cur_count) {
-  d->last_poll_data[d->last_idx] =
-      malloc(sizeof(*d->last_poll_data[d->last_idx]));
-  if (!d->last_poll_data[d->last_idx]) {
-    return -ENOMEM;
-  }
-  sstrncpy(d->last_poll_data[d->last_idx]->ds_name, ds_n,
-           sizeof(d->last_poll_data[d->last_idx]->ds_name));
-  d->last_poll_data[d->last_idx]->last_sum = cur_sum;
-  d->last_poll_data[d->last_idx]->last_count = cur_count;
-  d->last_idx = (d->last_idx + 1);
-  return 0;
-}
 
-/**
- * Update latency counter or add new entry if it doesn't exist
- */
-static int update_last(struct ceph_daemon *d, const char *ds_n, int index,
-                       double cur_sum, uint64_t cur_count) {
-  if ((d->last_idx > index) &&
-      (strcmp(d->last_poll_data[index]->ds_name, ds_n) == 0)) {
-    d->last_poll_data[index]->last_sum = cur_sum;
-    d->last_poll_data[index]->last_count = cur_count;
+  /* Recent releases describe counters with further numeric attributes, such
+   * as "priority". Only the type is of interest. */
+  if ((count_parts(key) <= 2) || !has_suffix(key, ".type"))
     return 0;
-  }
-
-  if (!d->last_poll_data) {
-    d->last_poll_data = malloc(sizeof(*d->last_poll_data));
-    if (!d->last_poll_data) {
-      return -ENOMEM;
-    }
-  } else {
-    struct last_data **tmp_last = realloc(
-        d->last_poll_data, ((d->last_idx + 1) * sizeof(struct last_data *)));
-    if (!tmp_last) {
-      return -ENOMEM;
-    }
-    d->last_poll_data = tmp_last;
-  }
-  return add_last(d, ds_n, cur_sum, cur_count);
-}
 
-/**
- * If using index guess failed (shouldn't happen, but possible if counters
- * get rearranged), resort to searching for counter name
- */
-static int backup_search_for_last_avg(struct ceph_daemon *d, const char *ds_n) {
-  for (int i = 0; i < d->last_idx; i++) {
-    if (strcmp(d->last_poll_data[i]->ds_name, ds_n) == 0) {
-      return i;
-    }
-  }
-  return -1;
+  pc_type = atoi(val);
+  return ceph_daemon_add_ds_entry(d, key, pc_type);
 }
 
 /**
  * Calculate average b/t current data and last poll data
  * if last poll data exists
  */
-static double get_last_avg(struct ceph_daemon *d, const char *ds_n, int index,
-                           double cur_sum, uint64_t cur_count) {
-  double result = -1.1, sum_delt = 0.0;
-  uint64_t count_delt = 0;
-  int tmp_index = 0;
-  if (d->last_idx > index) {
-    if (strcmp(d->last_poll_data[index]->ds_name, ds_n) == 0) {
-      tmp_index = index;
-    }
-    // test previous index
-    else if ((index > 0) &&
-             (strcmp(d->last_poll_data[index - 1]->ds_name, ds_n) == 0)) {
-      tmp_index = (index - 1);
-    } else {
-      tmp_index = backup_search_for_last_avg(d, ds_n);
-    }
+static double get_last_avg(struct ceph_daemon *d, int index, double cur_sum,
+                           uint64_t cur_count) {
+  struct last_data *last = d->last_poll_data + index;
+  double result = NAN;
 
-    if ((tmp_index > -1) &&
-        (cur_count > d->last_poll_data[tmp_index]->last_count)) {
-      sum_delt = (cur_sum - d->last_poll_data[tmp_index]->last_sum);
-      count_delt = (cur_count - d->last_poll_data[tmp_index]->last_count);
-      result = (sum_delt / count_delt);
-    }
+  if (last->valid && (cur_count > last->last_count)) {
+    result = (cur_sum - last->last_sum) /
+             (double)(cur_count - last->last_count);
   }
 
-  if (result == -1.1) {
-    result = NAN;
-  }
-  if (update_last(d, ds_n, tmp_index, cur_sum, cur_count) == -ENOMEM) {
-    return -ENOMEM;
-  }
+  last->valid = true;
+  last->last_sum = cur_sum;
+  last->last_count = cur_count;
   return result;
 }
 
 /**
- * If using index guess failed, resort to searching for counter name
+ * Look up the index of the counter a key of the data reply belongs to.
  */
-static uint32_t backup_search_for_type(struct ceph_daemon *d, char *ds_name) {
-  for (int i = 0; i < d->ds_num; i++) {
-    if (strcmp(d->ds_names[i], ds_name) == 0) {
-      return d->ds_types[i];
+static int ceph_daemon_find_ds(struct ceph_daemon *d, const char *key) {
+  const char *cut_suffixes[] = {".avgcount", ".sum", ".avgtime"};
+  char path[strlen(key) + 1];
+  void *value;
+
+  if (d->ds_index == NULL)
+    return -1;
+
+  sstrncpy(path, key, sizeof(path));
+  if (count_parts(key) > 2) {
+    for (size_t i = 0; i < STATIC_ARRAY_SIZE(cut_suffixes); i++) {
+      if (has_suffix(key, cut_suffixes[i])) {
+        cut_suffix(path, sizeof(path), key, cut_suffixes[i]);
+        break;
+      }
     }
   }
-  return DSET_TYPE_UNFOUND;
+
+  if (c_avl_get(d->ds_index, path, &value) != 0)
+    return -1;
+
+  return (int)(intptr_t)value;
 }
 
 /**
@@ -869,39 +839,23 @@ static int node_handler_fetch_data(void *arg, const char *val,
   double tmp_d;
   uint64_t tmp_u;
   struct values_tmp *vtmp = (struct values_tmp *)arg;
-  uint32_t type = DSET_TYPE_UNFOUND;
-  int index = vtmp->index;
-
-  char ds_name[DATA_MAX_NAME_LEN];
-
-  if (parse_keys(ds_name, sizeof(ds_name), key)) {
-    return 1;
-  }
+  uint32_t type;
+  int index;
 
-  if (index >= vtmp->d->ds_num) {
-    // don't overflow bounds of array
-    index = (vtmp->d->ds_num - 1);
-  }
+  char const *ds_name;
 
   /**
-   * counters should remain in same order we parsed schema... we maintain the
-   * index variable to keep track of current point in list of counters. first
-   * use index to guess point in array for retrieving type. if that doesn't
-   * work, use the old way to get the counter type
+   * Counters are resolved through the index built from the schema, so that
+   * no names have to be compacted and compared here. Counters missing from
+   * the schema are skipped.
    */
-  if (strcmp(ds_name, vtmp->d->ds_names[index]) == 0) {
-    // found match
-    type = vtmp->d->ds_types[index];
-  } else if ((index > 0) &&
-             (strcmp(ds_name, vtmp->d->ds_names[index - 1]) == 0)) {
-    // try previous key
-    type = vtmp->d->ds_types[index - 1];
-  }
-
-  if (type == DSET_TYPE_UNFOUND) {
-    // couldn't find right type by guessing, check the old way
-    type = backup_search_for_type(vtmp->d, ds_name);
+  index = ceph_daemon_find_ds(vtmp->d, key);
+  if (index < 0) {
+    DEBUG("ceph plugin: ignoring %s, which is not in the schema.", key);
+    return 0;
   }
+  type = vtmp->d->ds_types[index];
+  ds_name = vtmp->d->ds_names[index];
 
   switch (type) {
   case DSET_LATENCY:
@@ -919,15 +873,9 @@ static int node_handler_fetch_data(void *arg, const char *val,
       if (long_run_latency_avg) {
         return 0;
       }
-      double sum, result;
+      double sum;
       sscanf(val, "%lf", &sum);
-      result = get_last_avg(vtmp->d, ds_name, vtmp->latency_index, sum,
-                            vtmp->avgcount);
-      if (result == -ENOMEM) {
-        return -ENOMEM;
-      }
-      uv.gauge = result;
-      vtmp->latency_index = (vtmp->latency_index + 1);
+      uv.gauge = get_last_avg(vtmp->d, index, sum, vtmp->avgcount);
     } else if (has_suffix(key, ".avgtime")) {
 
       /* The "avgtime" metric reports ("sum" / "avgcount"), i.e. the average
@@ -942,7 +890,6 @@ static int node_handler_fetch_data(void *arg, const char *val,
       double result;
       sscanf(val, "%lf", &result);
       uv.gauge = result;
-      vtmp->latency_index = (vtmp->latency_index + 1);
     } else {
       WARNING("ceph plugin: ignoring unknown latency metric: %s", key);
       return 0;
@@ -968,7 +915,6 @@ static int node_handler_fetch_data(void *arg, const char *val,
   vtmp->vlist.values = &uv;
   vtmp->vlist.values_len = 1;
 
-  vtmp->index = (vtmp->index + 1);
   plugin_dispatch_values(&vtmp->vlist);
 
   return 0;
@@ -1043,8 +989,6 @@ static int cconn_process_data(struct cconn *io, yajl_struct *yajl,
            sizeof(vtmp->vlist.plugin_instance));
 
   vtmp->d = io->d;
-  vtmp->latency_index = 0;
-  vtmp->index = 0;
   yajl->handler_arg = vtmp;
   ret = traverse_json(io->json, io->json_len, hand);
   sfree(vtmp);
@@ -1086,12 +1030,19 @@ static int cconn_process_json(struct cconn *io) {
     break;
   case ASOK_REQ_SCHEMA:
     // init daemon specific variables
-    io->d->ds_num = 0;
-    io->d->last_idx = 0;
-    io->d->last_poll_data = NULL;
+    ceph_daemon_reset_schema(io->d);
     io->yajl.handler = node_handler_define_schema;
     io->yajl.handler_arg = io->d;
     result = traverse_json(io->json, io->json_len, hand);
+    if ((result == 0) && (io->d->ds_num > 0)) {
+      io->d->last_poll_data =
+          calloc(io->d->ds_num, sizeof(*io->d->last_poll_data));
+      if (io->d->last_poll_data == NULL) {
+        ERROR("ceph plugin: calloc failed.");
+        ceph_daemon_reset_schema(io->d);
+        result = ENOMEM;
+      }
+    }
     break;
   }
 
@@ -1305,25 +1256,26 @@ static int milli_diff(const struct timeval *t1, const struct timeval *t2) {
 
 /** This handles the actual network I/O to talk to the Ceph daemons.
  */
-static ssize_t cconn_main_loop(uint32_t request_type) {
+static ssize_t cconn_main_loop(struct ceph_daemon **daemons, size_t daemons_num,
+                               uint32_t request_type) {
   int some_unreachable = 0;
   ssize_t ret;
   struct timeval end_tv;
-  struct cconn io_array[g_num_daemons];
+  struct cconn io_array[daemons_num];
 
   DEBUG("ceph plugin: entering cconn_main_loop(request_type = %" PRIu32 ")",
         request_type);
 
-  if (g_num_daemons < 1) {
+  if (daemons_num < 1) {
     ERROR("ceph plugin: No daemons configured. See the \"Daemon\" config "
           "option.");
     return ENOENT;
   }
 
   /* create cconn array */
-  for (size_t i = 0; i < g_num_daemons; i++) {
+  for (size_t i = 0; i < daemons_num; i++) {
     io_array[i] = (struct cconn){
-        .d = g_daemons[i],
+        .d = daemons[i],
         .request_type = request_type,
         .state = CSTATE_UNCONNECTED,
         .asok = -1,
@@ -1337,11 +1289,11 @@ static ssize_t cconn_main_loop(uint32_t request_type) {
   while (1) {
     int nfds, diff;
     struct timeval tv;
-    struct cconn *polled_io_array[g_num_daemons];
-    struct pollfd fds[g_num_daemons];
+    struct cconn *polled_io_array[daemons_num];
+    struct pollfd fds[daemons_num];
     memset(fds, 0, sizeof(fds));
     nfds = 0;
-    for (size_t i = 0; i < g_num_daemons; ++i) {
+    for (size_t i = 0; i < daemons_num; ++i) {
       struct cconn *io = io_array + i;
       ret = cconn_prepare(io, fds + nfds);
       if (ret < 0) {
@@ -1400,7 +1352,7 @@ static ssize_t cconn_main_loop(uint32_t request_type) {
     }
   }
 done:
-  for (size_t i = 0; i < g_num_daemons; ++i) {
+  for (size_t i = 0; i < daemons_num; ++i) {
     cconn_close(io_array + i);
   }
   if (some_unreachable) {
@@ -1411,7 +1363,21 @@ done:
   return ret;
 }
 
-static int ceph_read(void) { return (int)cconn_main_loop(ASOK_REQ_DATA); }
+/* Each daemon has a read callback of its own, so that the read threads poll
+ * and parse the replies of several daemons at once. */
+static int ceph_read_daemon(user_data_t *ud) {
+  struct ceph_daemon *d = ud->data;
+
+  /* The schema could not be fetched during init. Try again before asking for
+   * data. */
+  if (d->ds_num == 0) {
+    ssize_t ret = cconn_main_loop(&d, 1, ASOK_REQ_VERSION);
+    if (ret != 0)
+      return (int)ret;
+  }
+
+  return (int)cconn_main_loop(&d, 1, ASOK_REQ_DATA);
+}
 
 /******* lifecycle *******/
 static int ceph_init(void) {
@@ -1438,7 +1404,29 @@ static int ceph_init(void) {
     return ENOENT;
   }
 
-  return (int)cconn_main_loop(ASOK_REQ_VERSION);
+  /* Fetch all schemas at once. Daemons that are unreachable now are retried
+   * by their read callbacks. */
+  ssize_t ret = cconn_main_loop(g_daemons, g_num_daemons, ASOK_REQ_VERSION);
+  if (ret != 0) {
+    WARNING("ceph plugin: Fetching the schemas failed with status %zd.", ret);
+  }
+
+  for (size_t i = 0; i < g_num_daemons; ++i) {
+    char callback_name[2 * DATA_MAX_NAME_LEN];
+
+    snprintf(callback_name, sizeof(callback_name), "ceph/%s",
+             g_daemons[i]->name);
+    plugin_register_complex_read(
+        /* group = */ "ceph",
+        /* name      = */ callback_name,
+        /* callback  = */ ceph_read_daemon,
+        /* interval  = */ 0,
+        &(user_data_t){
+            .data = g_daemons[i],
+        });
+  }
+
+  return 0;
 }
 
 static int ceph_shutdown(void) {
@@ -1455,6 +1443,5 @@ static int ceph_shutdown(void) {
 void module_register(void) {
   plugin_register_complex_config("ceph", ceph_config);
   plugin_register_init("ceph", ceph_init);
-  plugin_register_read("ceph", ceph_read);
   plugin_register_shutdown("ceph", ceph_shutdown);
 }
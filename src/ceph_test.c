@@ -181,9 +181,70 @@ DEF_TEST(parse_keys) {
   return 0;
 }
 
+DEF_TEST(schema_index) {
+  char const *json =
+      "{\n"
+      "    \"osd\": {\n"
+      "        \"op_w\": {\n"
+      "            \"type\": 10,\n"
+      "            \"metric_type\": \"counter\",\n"
+      "            \"description\": \"Client write operations\",\n"
+      "            \"priority\": 8\n"
+      "        },\n"
+      "        \"op_w_latency\": {\n"
+      "            \"type\": 5,\n"
+      "            \"priority\": 8\n"
+      "        },\n"
+      "        \"stat_bytes\": {\n"
+      "            \"type\": 2,\n"
+      "            \"priority\": 5\n"
+      "        }\n"
+      "    }\n"
+      "}\n";
+  struct ceph_daemon *d = calloc(1, sizeof(*d));
+  yajl_struct ctx = {node_handler_define_schema, d};
+
+  yajl_handle hndl;
+#if HAVE_YAJL_V2
+  hndl = yajl_alloc(&callbacks, NULL, &ctx);
+  CHECK_ZERO(
+      traverse_json((const unsigned char *)json, (uint32_t)strlen(json), hndl));
+  CHECK_ZERO(yajl_complete_parse(hndl));
+#else
+  hndl = yajl_alloc(&callbacks, NULL, NULL, &ctx);
+  CHECK_ZERO(
+      traverse_json((const unsigned char *)json, (uint32_t)strlen(json), hndl));
+  CHECK_ZERO(yajl_parse_complete(hndl));
+#endif
+  yajl_free(hndl);
+
+  /* "priority" must not be taken for a counter of its own. */
+  EXPECT_EQ_INT(3, d->ds_num);
+
+  EXPECT_EQ_INT(0, ceph_daemon_find_ds(d, "osd.op_w"));
+  EXPECT_EQ_STR("Osd.opW", d->ds_names[0]);
+  EXPECT_EQ_INT(DSET_RATE, d->ds_types[0]);
+
+  EXPECT_EQ_INT(1, ceph_daemon_find_ds(d, "osd.op_w_latency.avgcount"));
+  EXPECT_EQ_INT(1, ceph_daemon_find_ds(d, "osd.op_w_latency.sum"));
+  EXPECT_EQ_INT(1, ceph_daemon_find_ds(d, "osd.op_w_latency.avgtime"));
+  EXPECT_EQ_STR("Osd.opWLatency", d->ds_names[1]);
+  EXPECT_EQ_INT(DSET_LATENCY, d->ds_types[1]);
+
+  EXPECT_EQ_INT(2, ceph_daemon_find_ds(d, "osd.stat_bytes"));
+  EXPECT_EQ_INT(DSET_BYTES, d->ds_types[2]);
+
+  EXPECT_EQ_INT(-1, ceph_daemon_find_ds(d, "osd.op_r"));
+  EXPECT_EQ_INT(-1, ceph_daemon_find_ds(d, "osd.op_w_latency.sum_sq"));
+
+  ceph_daemon_free(d);
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(traverse_json);
   RUN_TEST(parse_keys);
+  RUN_TEST(schema_index);
 
   END_TEST;
 }
@@ -24,15 +24,32 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 #include "utils/ignorelist/ignorelist.h"
 #include "utils/mount/mount.h"
+#include "utils_complain.h"
 
-static char const *config_keys[] = {"CGroup", "IgnoreSelected"};
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/resource.h>
+
+static char const *config_keys[] = {"CGroup", "IgnoreSelected", "Hierarchy",
+                                    "Threads"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static ignorelist_t *il_cgroup;
 
+typedef enum {
+  CG_HIERARCHY_AUTO = 0,
+  CG_HIERARCHY_V1,
+  CG_HIERARCHY_V2,
+} cg_hierarchy_t;
+
+static cg_hierarchy_t cg_hierarchy = CG_HIERARCHY_AUTO;
+static int cg_threads_num = 1;
+
 __attribute__((nonnull(1))) __attribute__((nonnull(2))) static void
 cgroups_submit_one(char const *plugin_instance, char const *type_instance,
                    value_t value) {
@@ -154,6 +171,744 @@ static int read_cpuacct_root(const char *dirname, const char *filename,
   return 0;
 }
 
+/*
+ * cgroup v2 (unified hierarchy)
+ *
+ * The tree below the cgroup2 mount point is scanned once. Every cgroup keeps
+ * an open directory file descriptor and an inotify watch, so later reads only
+ * have to apply the creations and removals reported by the kernel. The stat
+ * files are opened relative to the cached descriptor and read with a single
+ * pread(2) into a buffer that is reused across reads.
+ */
+#define CG_INOTIFY_MASK                                                        \
+  (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR)
+
+typedef struct {
+  char *path; /* relative to the root; "" for the root itself */
+  char plugin_instance[DATA_MAX_NAME_LEN];
+  int dirfd; /* -1 once the descriptor budget is used up */
+  int wd;
+  bool selected;
+} cg_node_t;
+
+typedef struct {
+  char *data;
+  size_t size;
+} cg_buffer_t;
+
+static char *cg_root_dir;
+static int cg_inotify_fd = -1;
+static c_avl_tree_t *cg_nodes_by_path;
+static c_avl_tree_t *cg_nodes_by_wd;
+static cg_node_t *cg_root;
+static size_t cg_dirfds_num;
+static size_t cg_dirfds_max;
+/* Set when inotify cannot be used or events were lost. The tree is then
+ * scanned again on the next read. */
+static bool cg_rescan;
+static c_complain_t cg_watch_complaint = C_COMPLAIN_INIT_STATIC;
+
+/* Selected cgroups, rebuilt whenever the tree changes. */
+static cg_node_t **cg_selected;
+static size_t cg_selected_num;
+static bool cg_selected_dirty = true;
+static cg_buffer_t cg_read_buffer;
+static long cg_clock_ticks;
+
+/* Worker pool used when "Threads" is larger than one. The read callback
+ * hands out the selected cgroups through "cg_work_next" and reads its share
+ * of them, too. */
+static pthread_mutex_t cg_work_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cg_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t cg_done_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t *cg_workers;
+static size_t cg_workers_num;
+static uint64_t cg_work_gen;
+static size_t cg_work_next;
+static size_t cg_work_pending;
+static bool cg_work_stop;
+
+static int cg_wd_compare(const void *a, const void *b) {
+  int wd_a = *((const int *)a);
+  int wd_b = *((const int *)b);
+  return (wd_a > wd_b) - (wd_a < wd_b);
+} /* int cg_wd_compare */
+
+static void cg_node_destroy(cg_node_t *n) {
+  if (n == NULL)
+    return;
+
+  if (n->wd >= 0) {
+    c_avl_remove(cg_nodes_by_wd, &n->wd, NULL, NULL);
+    /* Fails harmlessly if the kernel already dropped the watch. */
+    inotify_rm_watch(cg_inotify_fd, n->wd);
+  }
+  if (n->dirfd >= 0) {
+    close(n->dirfd);
+    cg_dirfds_num--;
+  }
+  sfree(n->path);
+  sfree(n);
+} /* void cg_node_destroy */
+
+static void cg_tree_destroy(void) {
+  cg_node_t *n;
+  char *key;
+
+  if (cg_nodes_by_path != NULL) {
+    while (c_avl_pick(cg_nodes_by_path, (void *)&key, (void *)&n) == 0)
+      cg_node_destroy(n);
+    c_avl_destroy(cg_nodes_by_path);
+    cg_nodes_by_path = NULL;
+  }
+  if (cg_nodes_by_wd != NULL) {
+    c_avl_destroy(cg_nodes_by_wd);
+    cg_nodes_by_wd = NULL;
+  }
+  if (cg_inotify_fd >= 0) {
+    close(cg_inotify_fd);
+    cg_inotify_fd = -1;
+  }
+
+  cg_root = NULL;
+  sfree(cg_selected);
+  cg_selected_num = 0;
+  cg_selected_dirty = true;
+} /* void cg_tree_destroy */
+
+/* Removes "path" and everything below it. */
+static void cg_tree_remove(char const *path) /* {{{ */
+{
+  size_t path_len = strlen(path);
+  cg_node_t **remove = NULL;
+  size_t remove_num = 0;
+  char *key;
+  cg_node_t *n;
+
+  /* Entries below "path" are not contiguous in strcmp() order ("a/b-c"
+   * sorts between "a/b" and "a/b/c"), so check all of them. */
+  c_avl_iterator_t *iter = c_avl_get_iterator(cg_nodes_by_path);
+  while (c_avl_iterator_next(iter, (void *)&key, (void *)&n) == 0) {
+    if (n == cg_root || strncmp(key, path, path_len) != 0 ||
+        (key[path_len] != 0 && key[path_len] != '/'))
+      continue;
+
+    cg_node_t **tmp = realloc(remove, (remove_num + 1) * sizeof(*remove));
+    if (tmp == NULL)
+      break;
+    remove = tmp;
+    remove[remove_num++] = n;
+  }
+  c_avl_iterator_destroy(iter);
+
+  for (size_t i = 0; i < remove_num; i++) {
+    c_avl_remove(cg_nodes_by_path, remove[i]->path, NULL, NULL);
+    cg_node_destroy(remove[i]);
+  }
+  if (remove_num > 0)
+    cg_selected_dirty = true;
+  sfree(remove);
+} /* }}} void cg_tree_remove */
+
+static int cg_scan(cg_node_t *parent);
+
+/* Adds the cgroup "name" below "parent" and scans its children. */
+static int cg_tree_add(cg_node_t *parent, char const *name) /* {{{ */
+{
+  char path[PATH_MAX];
+  char abs_path[PATH_MAX];
+
+  int len;
+  if (parent == NULL || parent->path[0] == 0)
+    len = snprintf(path, sizeof(path), "%s", name);
+  else
+    len = snprintf(path, sizeof(path), "%s/%s", parent->path, name);
+  if (len < 0 || (size_t)len >= sizeof(path))
+    return ENAMETOOLONG;
+  len = snprintf(abs_path, sizeof(abs_path), "%s%s%s", cg_root_dir,
+                 (path[0] != 0) ? "/" : "", path);
+  if (len < 0 || (size_t)len >= sizeof(abs_path))
+    return ENAMETOOLONG;
+
+  if (c_avl_get(cg_nodes_by_path, path, NULL) == 0)
+    return 0;
+
+  cg_node_t *n = calloc(1, sizeof(*n));
+  if (n == NULL)
+    return ENOMEM;
+  n->dirfd = -1;
+  n->wd = -1;
+  n->path = strdup(path);
+  if (n->path == NULL) {
+    sfree(n);
+    return ENOMEM;
+  }
+
+  /* Watch before reading the directory, so no child created in between is
+   * missed. Duplicates are caught by the lookup above. */
+  if (!cg_rescan) {
+    n->wd = inotify_add_watch(cg_inotify_fd, abs_path, CG_INOTIFY_MASK);
+    if (n->wd < 0) {
+      c_complain(LOG_WARNING, &cg_watch_complaint,
+                 "cgroups plugin: inotify_add_watch (\"%s\") failed: %s. "
+                 "The cgroup tree will be scanned on every read.",
+                 abs_path, STRERRNO);
+      cg_rescan = true;
+    }
+  }
+
+  if (cg_dirfds_num < cg_dirfds_max) {
+    if (parent != NULL && parent->dirfd >= 0)
+      n->dirfd = openat(parent->dirfd, name,
+                        O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+    else
+      n->dirfd = open(abs_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (n->dirfd >= 0)
+      cg_dirfds_num++;
+  }
+
+  if (parent != NULL) {
+    n->selected = !ignorelist_match(il_cgroup, path);
+
+    /* The path is the plugin instance with slashes replaced. If it is too
+     * long, keep the end: it is the part that tells cgroups apart. */
+    size_t len = strlen(path);
+    char const *src = path;
+    if (len >= sizeof(n->plugin_instance))
+      src += len - (sizeof(n->plugin_instance) - 1);
+    sstrncpy(n->plugin_instance, src, sizeof(n->plugin_instance));
+    for (char *c = n->plugin_instance; *c != 0; c++)
+      if (*c == '/')
+        *c = '-';
+  }
+
+  if (c_avl_insert(cg_nodes_by_path, n->path, n) != 0) {
+    cg_node_destroy(n);
+    return ENOMEM;
+  }
+  if (n->wd >= 0 && c_avl_insert(cg_nodes_by_wd, &n->wd, n) != 0) {
+    c_avl_remove(cg_nodes_by_path, n->path, NULL, NULL);
+    cg_node_destroy(n);
+    return ENOMEM;
+  }
+  if (parent == NULL)
+    cg_root = n;
+  cg_selected_dirty = true;
+
+  return cg_scan(n);
+} /* }}} int cg_tree_add */
+
+static int cg_scan(cg_node_t *parent) /* {{{ */
+{
+  DIR *dh;
+
+  if (parent->dirfd >= 0) {
+    int fd = dup(parent->dirfd);
+    if (fd < 0)
+      return errno;
+    dh = fdopendir(fd);
+    if (dh == NULL) {
+      close(fd);
+      return errno;
+    }
+    rewinddir(dh);
+  } else {
+    char abs_path[PATH_MAX];
+    snprintf(abs_path, sizeof(abs_path), "%s%s%s", cg_root_dir,
+             (parent->path[0] != 0) ? "/" : "", parent->path);
+    dh = opendir(abs_path);
+    if (dh == NULL)
+      return errno;
+  }
+
+  struct dirent *de;
+  while ((de = readdir(dh)) != NULL) {
+    if (de->d_name[0] == '.')
+      continue;
+    if (de->d_type != DT_DIR)
+      continue;
+    cg_tree_add(parent, de->d_name);
+  }
+
+  closedir(dh);
+  return 0;
+} /* }}} int cg_scan */
+
+static int cg_tree_build(void) /* {{{ */
+{
+  cg_tree_destroy();
+
+  cg_nodes_by_path = c_avl_create((int (*)(const void *, const void *))strcmp);
+  cg_nodes_by_wd = c_avl_create(cg_wd_compare);
+  if (cg_nodes_by_path == NULL || cg_nodes_by_wd == NULL) {
+    cg_tree_destroy();
+    return ENOMEM;
+  }
+
+  cg_rescan = false;
+  cg_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (cg_inotify_fd < 0) {
+    c_complain(LOG_WARNING, &cg_watch_complaint,
+               "cgroups plugin: inotify_init1 failed: %s. The cgroup tree "
+               "will be scanned on every read.",
+               STRERRNO);
+    cg_rescan = true;
+  }
+
+  /* Leave room for the descriptors everybody else needs. */
+  struct rlimit rl;
+  cg_dirfds_max = 512;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+    cg_dirfds_max = rl.rlim_cur / 2;
+
+  int status = cg_tree_add(NULL, "");
+  if (status != 0 || cg_root == NULL) {
+    ERROR("cgroups plugin: Reading the cgroup tree at \"%s\" failed.",
+          cg_root_dir);
+    cg_tree_destroy();
+    return -1;
+  }
+
+  if (!cg_rescan)
+    c_release(LOG_INFO, &cg_watch_complaint,
+              "cgroups plugin: Watching the cgroup tree with inotify again.");
+  return 0;
+} /* }}} int cg_tree_build */
+
+/* Applies the changes reported by inotify since the last read. */
+static int cg_tree_update(void) /* {{{ */
+{
+  char buf[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+  if (cg_nodes_by_path == NULL || cg_rescan)
+    return cg_tree_build();
+
+  while (42) {
+    ssize_t len = read(cg_inotify_fd, buf, sizeof(buf));
+    if (len < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+      ERROR("cgroups plugin: Reading inotify events failed: %s", STRERRNO);
+      return cg_tree_build();
+    }
+
+    for (char *ptr = buf; ptr < buf + len;) {
+      struct inotify_event const *ev = (struct inotify_event const *)ptr;
+      ptr += sizeof(*ev) + ev->len;
+
+      if (ev->mask & IN_Q_OVERFLOW) {
+        NOTICE("cgroups plugin: inotify queue overflow, scanning the cgroup "
+               "tree again.");
+        return cg_tree_build();
+      }
+
+      cg_node_t *parent = NULL;
+      if (c_avl_get(cg_nodes_by_wd, &ev->wd, (void *)&parent) != 0)
+        continue;
+
+      if (ev->mask & IN_IGNORED) {
+        /* The directory itself is gone. */
+        if (parent != cg_root) {
+          char *path = strdup(parent->path);
+          if (path != NULL) {
+            c_avl_remove(cg_nodes_by_wd, &parent->wd, NULL, NULL);
+            parent->wd = -1;
+            cg_tree_remove(path);
+            sfree(path);
+          }
+        }
+        continue;
+      }
+
+      if (!(ev->mask & IN_ISDIR) || ev->len == 0)
+        continue;
+
+      if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+        cg_tree_add(parent, ev->name);
+      } else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        char path[PATH_MAX];
+        if (parent->path[0] == 0)
+          snprintf(path, sizeof(path), "%s", ev->name);
+        else
+          snprintf(path, sizeof(path), "%s/%s", parent->path, ev->name);
+        cg_tree_remove(path);
+      }
+    }
+  }
+
+  return 0;
+} /* }}} int cg_tree_update */
+
+static int cg_selected_update(void) {
+  if (!cg_selected_dirty)
+    return 0;
+
+  size_t num = (size_t)c_avl_size(cg_nodes_by_path);
+  cg_node_t **tmp = realloc(cg_selected, (num + 1) * sizeof(*tmp));
+  if (tmp == NULL)
+    return ENOMEM;
+  cg_selected = tmp;
+  cg_selected_num = 0;
+
+  c_avl_iterator_t *iter = c_avl_get_iterator(cg_nodes_by_path);
+  char *key;
+  cg_node_t *n;
+  while (c_avl_iterator_next(iter, (void *)&key, (void *)&n) == 0) {
+    if (n != cg_root && n->selected)
+      cg_selected[cg_selected_num++] = n;
+  }
+  c_avl_iterator_destroy(iter);
+
+  cg_selected_dirty = false;
+  return 0;
+} /* int cg_selected_update */
+
+/* Reads "file" of cgroup "n" into "b". Returns the length or -1. */
+static ssize_t cg_read_file(cg_node_t *n, char const *file,
+                            cg_buffer_t *b) /* {{{ */
+{
+  int fd;
+
+  if (n->dirfd >= 0) {
+    fd = openat(n->dirfd, file, O_RDONLY | O_CLOEXEC);
+  } else {
+    char abs_path[PATH_MAX];
+    snprintf(abs_path, sizeof(abs_path), "%s/%s/%s", cg_root_dir, n->path,
+             file);
+    fd = open(abs_path, O_RDONLY | O_CLOEXEC);
+  }
+  if (fd < 0)
+    return -1;
+
+  if (b->size == 0) {
+    b->data = malloc(4096);
+    if (b->data == NULL) {
+      close(fd);
+      return -1;
+    }
+    b->size = 4096;
+  }
+
+  ssize_t len;
+  while (42) {
+    len = pread(fd, b->data, b->size - 1, 0);
+    if (len < 0 && errno == EINTR)
+      continue;
+    if (len < 0 || (size_t)len < b->size - 1)
+      break;
+
+    /* The file did not fit. Kernel stat files are generated in one go, so
+     * grow the buffer and read again from the start. */
+    char *tmp = realloc(b->data, 2 * b->size);
+    if (tmp == NULL) {
+      len = -1;
+      break;
+    }
+    b->data = tmp;
+    b->size *= 2;
+  }
+  close(fd);
+
+  if (len < 0)
+    return -1;
+  b->data[len] = 0;
+  return len;
+} /* }}} ssize_t cg_read_file */
+
+static void cg_submit(value_list_t *vl, char const *type,
+                      char const *type_instance, value_t *values,
+                      size_t values_len) {
+  vl->values = values;
+  vl->values_len = values_len;
+  sstrncpy(vl->type, type, sizeof(vl->type));
+  sstrncpy(vl->type_instance, type_instance, sizeof(vl->type_instance));
+  plugin_dispatch_values(vl);
+} /* void cg_submit */
+
+/* Splits the next "key value" line off "*ptr". */
+static bool cg_next_pair(char **ptr, char **key, uint64_t *value) {
+  while (**ptr != 0) {
+    char *line = *ptr;
+    char *end = strchr(line, '\n');
+    if (end != NULL) {
+      *end = 0;
+      *ptr = end + 1;
+    } else {
+      *ptr = line + strlen(line);
+    }
+
+    char *sep = strchr(line, ' ');
+    if (sep == NULL)
+      continue;
+    *sep = 0;
+
+    char *endptr = NULL;
+    errno = 0;
+    *value = (uint64_t)strtoull(sep + 1, &endptr, 10);
+    if (errno != 0 || endptr == sep + 1)
+      continue;
+
+    *key = line;
+    return true;
+  }
+
+  return false;
+} /* bool cg_next_pair */
+
+static void cg_read_cpu(cg_node_t *n, value_list_t *vl, cg_buffer_t *b) {
+  if (cg_read_file(n, "cpu.stat", b) < 0)
+    return;
+
+  char *ptr = b->data;
+  char *key;
+  uint64_t value;
+  while (cg_next_pair(&ptr, &key, &value)) {
+    /* Report user and system time in USER_HZ like cpuacct.stat does. */
+    if (strcmp(key, "user_usec") == 0 || strcmp(key, "system_usec") == 0) {
+      key[strlen(key) - strlen("_usec")] = 0;
+      value_t v = {.derive = (derive_t)(value * cg_clock_ticks / 1000000)};
+      cg_submit(vl, "cpu", key, &v, 1);
+    } else if (strcmp(key, "nr_throttled") == 0) {
+      cg_submit(vl, "operations", "throttled",
+                &(value_t){.derive = (derive_t)value}, 1);
+    } else if (strcmp(key, "throttled_usec") == 0) {
+      cg_submit(vl, "total_time_in_ms", "throttled",
+                &(value_t){.derive = (derive_t)(value / 1000)}, 1);
+    }
+  }
+} /* void cg_read_cpu */
+
+static void cg_read_memory(cg_node_t *n, value_list_t *vl, cg_buffer_t *b) {
+  static char const *const memory_keys[] = {
+      "anon",       "file",        "kernel_stack",   "slab", "sock",
+      "shmem",      "file_mapped", "file_dirty",     "file_writeback",
+      "swapcached", "unevictable", "anon_thp",
+  };
+
+  if (cg_read_file(n, "memory.stat", b) < 0)
+    return;
+
+  char *ptr = b->data;
+  char *key;
+  uint64_t value;
+  uint64_t pgfault = 0;
+  uint64_t pgmajfault = 0;
+  bool have_faults = false;
+  while (cg_next_pair(&ptr, &key, &value)) {
+    if (strcmp(key, "pgfault") == 0) {
+      pgfault = value;
+      have_faults = true;
+      continue;
+    } else if (strcmp(key, "pgmajfault") == 0) {
+      pgmajfault = value;
+      continue;
+    }
+
+    for (size_t i = 0; i < STATIC_ARRAY_SIZE(memory_keys); i++) {
+      if (strcmp(key, memory_keys[i]) == 0) {
+        cg_submit(vl, "memory", key, &(value_t){.gauge = (gauge_t)value}, 1);
+        break;
+      }
+    }
+  }
+
+  if (have_faults) {
+    if (pgmajfault > pgfault)
+      pgmajfault = pgfault;
+    value_t v[] = {{.derive = (derive_t)(pgfault - pgmajfault)},
+                   {.derive = (derive_t)pgmajfault}};
+    cg_submit(vl, "vmpage_faults", "", v, STATIC_ARRAY_SIZE(v));
+  }
+} /* void cg_read_memory */
+
+static void cg_read_io(cg_node_t *n, value_list_t *vl, cg_buffer_t *b) {
+  if (cg_read_file(n, "io.stat", b) < 0)
+    return;
+
+  /* Expected format:
+   *
+   *   8:0 rbytes=1024 wbytes=4096 rios=1 wios=1 dbytes=0 dios=0
+   */
+  char *saveptr = NULL;
+  for (char *line = strtok_r(b->data, "\n", &saveptr); line != NULL;
+       line = strtok_r(NULL, "\n", &saveptr)) {
+    char *fields[16];
+    int fields_num = strsplit(line, fields, STATIC_ARRAY_SIZE(fields));
+    if (fields_num < 2)
+      continue;
+
+    derive_t rbytes = 0, wbytes = 0, rios = 0, wios = 0;
+    for (int i = 1; i < fields_num; i++) {
+      char *value = strchr(fields[i], '=');
+      if (value == NULL)
+        continue;
+      *value++ = 0;
+
+      derive_t *dst = NULL;
+      if (strcmp(fields[i], "rbytes") == 0)
+        dst = &rbytes;
+      else if (strcmp(fields[i], "wbytes") == 0)
+        dst = &wbytes;
+      else if (strcmp(fields[i], "rios") == 0)
+        dst = &rios;
+      else if (strcmp(fields[i], "wios") == 0)
+        dst = &wios;
+      if (dst != NULL)
+        *dst = (derive_t)strtoull(value, NULL, 10);
+    }
+
+    /* "8:0" -> "8-0": colons are not welcome in file names. */
+    for (char *c = fields[0]; *c != 0; c++)
+      if (*c == ':')
+        *c = '-';
+
+    cg_submit(vl, "disk_octets", fields[0],
+              (value_t[]){{.derive = rbytes}, {.derive = wbytes}}, 2);
+    cg_submit(vl, "disk_ops", fields[0],
+              (value_t[]){{.derive = rios}, {.derive = wios}}, 2);
+  }
+} /* void cg_read_io */
+
+static void cg_read_node(cg_node_t *n, cg_buffer_t *b) {
+  value_list_t vl = VALUE_LIST_INIT;
+
+  sstrncpy(vl.plugin, "cgroups", sizeof(vl.plugin));
+  sstrncpy(vl.plugin_instance, n->plugin_instance, sizeof(vl.plugin_instance));
+
+  cg_read_cpu(n, &vl, b);
+  cg_read_memory(n, &vl, b);
+  cg_read_io(n, &vl, b);
+} /* void cg_read_node */
+
+static void cg_read_share(cg_buffer_t *b) {
+  size_t i;
+  while ((i = __atomic_fetch_add(&cg_work_next, 1, __ATOMIC_RELAXED)) <
+         cg_selected_num)
+    cg_read_node(cg_selected[i], b);
+} /* void cg_read_share */
+
+static void *cg_worker(void __attribute__((unused)) * arg) /* {{{ */
+{
+  cg_buffer_t b = {0};
+  uint64_t gen = 0;
+
+  pthread_mutex_lock(&cg_work_lock);
+  while (!cg_work_stop) {
+    if (gen == cg_work_gen) {
+      pthread_cond_wait(&cg_work_cond, &cg_work_lock);
+      continue;
+    }
+    gen = cg_work_gen;
+    pthread_mutex_unlock(&cg_work_lock);
+
+    cg_read_share(&b);
+
+    pthread_mutex_lock(&cg_work_lock);
+    cg_work_pending--;
+    if (cg_work_pending == 0)
+      pthread_cond_signal(&cg_done_cond);
+  }
+  pthread_mutex_unlock(&cg_work_lock);
+
+  sfree(b.data);
+  return NULL;
+} /* }}} void *cg_worker */
+
+static void cg_workers_start(void) {
+  if (cg_workers != NULL || cg_threads_num < 2)
+    return;
+
+  cg_workers = calloc((size_t)cg_threads_num - 1, sizeof(*cg_workers));
+  if (cg_workers == NULL)
+    return;
+
+  for (int i = 0; i < cg_threads_num - 1; i++) {
+    int status = plugin_thread_create(&cg_workers[cg_workers_num], cg_worker,
+                                      NULL, "cgroups read");
+    if (status != 0) {
+      ERROR("cgroups plugin: plugin_thread_create failed: %s",
+            STRERROR(status));
+      break;
+    }
+    cg_workers_num++;
+  }
+} /* void cg_workers_start */
+
+static void cg_workers_stop(void) {
+  pthread_mutex_lock(&cg_work_lock);
+  cg_work_stop = true;
+  pthread_cond_broadcast(&cg_work_cond);
+  pthread_mutex_unlock(&cg_work_lock);
+
+  for (size_t i = 0; i < cg_workers_num; i++)
+    pthread_join(cg_workers[i], NULL);
+  sfree(cg_workers);
+  cg_workers_num = 0;
+} /* void cg_workers_stop */
+
+static char *cg_find_root(void) {
+  cu_mount_t *mnt_list = NULL;
+  char *dir = NULL;
+
+  if (cu_mount_getlist(&mnt_list) == NULL) {
+    ERROR("cgroups plugin: cu_mount_getlist failed.");
+    return NULL;
+  }
+
+  for (cu_mount_t *mnt_ptr = mnt_list; mnt_ptr != NULL;
+       mnt_ptr = mnt_ptr->next) {
+    if (strcmp(mnt_ptr->type, "cgroup2") == 0) {
+      dir = strdup(mnt_ptr->dir);
+      break;
+    }
+  }
+
+  cu_mount_freelist(mnt_list);
+  return dir;
+} /* char *cg_find_root */
+
+static int cgroups_read_v2(void) /* {{{ */
+{
+  if (cg_root_dir == NULL) {
+    cg_root_dir = cg_find_root();
+    if (cg_root_dir == NULL) {
+      WARNING("cgroups plugin: Unable to find a cgroup2 mount-point.");
+      return -1;
+    }
+    cg_clock_ticks = sysconf(_SC_CLK_TCK);
+    if (cg_clock_ticks <= 0)
+      cg_clock_ticks = 100;
+  }
+
+  if (cg_tree_update() != 0 || cg_selected_update() != 0)
+    return -1;
+
+  cg_workers_start();
+  if (cg_workers_num == 0) {
+    cg_work_next = 0;
+    cg_read_share(&cg_read_buffer);
+    return 0;
+  }
+
+  pthread_mutex_lock(&cg_work_lock);
+  cg_work_next = 0;
+  cg_work_pending = cg_workers_num;
+  cg_work_gen++;
+  pthread_cond_broadcast(&cg_work_cond);
+  pthread_mutex_unlock(&cg_work_lock);
+
+  cg_read_share(&cg_read_buffer);
+
+  pthread_mutex_lock(&cg_work_lock);
+  while (cg_work_pending > 0)
+    pthread_cond_wait(&cg_done_cond, &cg_work_lock);
+  pthread_mutex_unlock(&cg_work_lock);
+
+  return 0;
+} /* }}} int cgroups_read_v2 */
+
 static int cgroups_init(void) {
   if (il_cgroup == NULL)
     il_cgroup = ignorelist_create(1);
@@ -174,6 +929,28 @@ static int cgroups_config(const char *key, const char *value) {
     else
       ignorelist_set_invert(il_cgroup, 1);
     return 0;
+  } else if (strcasecmp(key, "Hierarchy") == 0) {
+    if (strcasecmp(value, "auto") == 0)
+      cg_hierarchy = CG_HIERARCHY_AUTO;
+    else if (strcasecmp(value, "v1") == 0)
+      cg_hierarchy = CG_HIERARCHY_V1;
+    else if (strcasecmp(value, "v2") == 0)
+      cg_hierarchy = CG_HIERARCHY_V2;
+    else {
+      ERROR("cgroups plugin: Invalid Hierarchy \"%s\". Expected \"auto\", "
+            "\"v1\" or \"v2\".",
+            value);
+      return 1;
+    }
+    return 0;
+  } else if (strcasecmp(key, "Threads") == 0) {
+    int tmp = atoi(value);
+    if (tmp < 1) {
+      ERROR("cgroups plugin: Threads must be at least one.");
+      return 1;
+    }
+    cg_threads_num = tmp;
+    return 0;
   }
 
   return -1;
@@ -183,6 +960,9 @@ static int cgroups_read(void) {
   cu_mount_t *mnt_list = NULL;
   bool cgroup_found = false;
 
+  if (cg_hierarchy == CG_HIERARCHY_V2)
+    return cgroups_read_v2();
+
   if (cu_mount_getlist(&mnt_list) == NULL) {
     ERROR("cgroups plugin: cu_mount_getlist failed.");
     return -1;
@@ -207,7 +987,17 @@ static int cgroups_read(void) {
 
   cu_mount_freelist(mnt_list);
 
-  if (!cgroup_found) {
+  if (!cgroup_found && cg_hierarchy == CG_HIERARCHY_AUTO) {
+    /* No cpuacct controller on a v1 hierarchy: this is most likely a
+     * unified-only system, so stop looking for one. */
+    int status = cgroups_read_v2();
+    if (status == 0) {
+      INFO("cgroups plugin: Reading the unified cgroup hierarchy at \"%s\".",
+           cg_root_dir);
+      cg_hierarchy = CG_HIERARCHY_V2;
+    }
+    return status;
+  } else if (!cgroup_found) {
     WARNING("cgroups plugin: Unable to find cgroup "
             "mount-point with the \"cpuacct\" option.");
     return -1;
@@ -216,9 +1006,20 @@ static int cgroups_read(void) {
   return 0;
 } /* int cgroup_read */
 
+static int cgroups_shutdown(void) {
+  cg_workers_stop();
+  cg_tree_destroy();
+  sfree(cg_read_buffer.data);
+  cg_read_buffer.size = 0;
+  sfree(cg_root_dir);
+
+  return 0;
+} /* int cgroups_shutdown */
+
 void module_register(void) {
   plugin_register_config("cgroups", cgroups_config, config_keys,
                          config_keys_num);
   plugin_register_init("cgroups", cgroups_init);
   plugin_register_read("cgroups", cgroups_read);
+  plugin_register_shutdown("cgroups", cgroups_shutdown);
 } /* void module_register */
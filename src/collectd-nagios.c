@@ -39,6 +39,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <time.h>
 #include <unistd.h>
 
 #if NAN_STATIC_DEFAULT
@@ -91,20 +92,31 @@ struct range_s {
 };
 typedef struct range_s range_t;
 
+/* One check: the value to examine and how to rate it. */
+struct check_s {
+  char *hostname;
+  char *value_string;
+  char *description;
+
+  range_t range_critical;
+  range_t range_warning;
+  int consolitation;
+  bool nan_is_error;
+
+  char **match_ds;
+  size_t match_ds_num;
+};
+typedef struct check_s check_t;
+
 extern char *optarg;
 extern int optind, opterr, optopt;
 
 static char *socket_file_g;
-static char *value_string_g;
-static char *hostname_g;
+static char *batch_file_g;
 
-static range_t range_critical_g;
-static range_t range_warning_g;
-static int consolitation_g = CON_NONE;
-static bool nan_is_error_g;
-
-static char **match_ds_g;
-static size_t match_ds_num_g;
+/* The check given on the command line. In batch mode it provides the
+ * defaults for the checks read from the batch file. */
+static check_t check_g;
 
 /* `strdup' is an XSI extension. I don't want to pull in all of XSI just for
  * that, so here's an own implementation.. It's easy enough. The GCC attributes
@@ -122,32 +134,72 @@ cn_strdup(const char *str) /* {{{ */
   return ret;
 } /* }}} char *cn_strdup */
 
-static int filter_ds(size_t *values_num, double **values,
-                     char ***values_names) {
+static void check_init(check_t *check) {
+  memset(check, 0, sizeof(*check));
+
+  check->range_critical.min = NAN;
+  check->range_critical.max = NAN;
+  check->range_critical.invert = 0;
+
+  check->range_warning.min = NAN;
+  check->range_warning.max = NAN;
+  check->range_warning.invert = 0;
+
+  check->consolitation = CON_NONE;
+} /* void check_init */
+
+static void check_destroy(check_t *check) {
+  for (size_t i = 0; i < check->match_ds_num; i++)
+    free(check->match_ds[i]);
+  free(check->match_ds);
+  check->match_ds = NULL;
+  check->match_ds_num = 0;
+} /* void check_destroy */
+
+static int check_add_ds(check_t *check, const char *ds) {
+  char **tmp;
+
+  tmp = realloc(check->match_ds, (check->match_ds_num + 1) * sizeof(char *));
+  if (tmp == NULL) {
+    fprintf(stderr, "realloc failed: %s\n", strerror(errno));
+    return -1;
+  }
+  check->match_ds = tmp;
+  check->match_ds[check->match_ds_num] = cn_strdup(ds);
+  if (check->match_ds[check->match_ds_num] == NULL) {
+    fprintf(stderr, "cn_strdup failed: %s\n", strerror(errno));
+    return -1;
+  }
+  check->match_ds_num++;
+  return 0;
+} /* int check_add_ds */
+
+static int filter_ds(const check_t *check, FILE *out, size_t *values_num,
+                     double **values, char ***values_names) {
   gauge_t *new_values;
   char **new_names;
 
-  if (match_ds_g == NULL)
+  if (check->match_ds == NULL)
     return RET_OKAY;
 
-  new_values = calloc(match_ds_num_g, sizeof(*new_values));
+  new_values = calloc(check->match_ds_num, sizeof(*new_values));
   if (new_values == NULL) {
     fprintf(stderr, "calloc failed: %s\n", strerror(errno));
     return RET_UNKNOWN;
   }
 
-  new_names = calloc(match_ds_num_g, sizeof(*new_names));
+  new_names = calloc(check->match_ds_num, sizeof(*new_names));
   if (new_names == NULL) {
     fprintf(stderr, "calloc failed: %s\n", strerror(errno));
     free(new_values);
     return RET_UNKNOWN;
   }
 
-  for (size_t i = 0; i < match_ds_num_g; i++) {
+  for (size_t i = 0; i < check->match_ds_num; i++) {
     size_t j;
 
-    /* match_ds_g keeps pointers into argv but the names will be freed */
-    new_names[i] = cn_strdup(match_ds_g[i]);
+    /* the names in *values_names will be freed */
+    new_names[i] = cn_strdup(check->match_ds[i]);
     if (new_names[i] == NULL) {
       fprintf(stderr, "cn_strdup failed: %s\n", strerror(errno));
       free(new_values);
@@ -162,7 +214,7 @@ static int filter_ds(size_t *values_num, double **values,
         break;
 
     if (j == *values_num) {
-      printf("ERROR: DS `%s' is not available.\n", new_names[i]);
+      fprintf(out, "ERROR: DS `%s' is not available.\n", new_names[i]);
       free(new_values);
       for (j = 0; j <= i; j++)
         free(new_names[j]);
@@ -180,10 +232,9 @@ static int filter_ds(size_t *values_num, double **values,
 
   *values = new_values;
   *values_names = new_names;
-  *values_num = match_ds_num_g;
+  *values_num = check->match_ds_num;
   return RET_OKAY;
 } /* int filter_ds */
-
 static void parse_range(char *string, range_t *range) {
   char *min_ptr;
   char *max_ptr;
@@ -220,7 +271,7 @@ static void parse_range(char *string, range_t *range) {
     range->max = atof(max_ptr);
 } /* void parse_range */
 
-static int match_range(range_t *range, double value) {
+static int match_range(const range_t *range, double value) {
   int ret = 0;
 
   if (!isnan(range->min) && (range->min > value))
@@ -234,6 +285,7 @@ static int match_range(range_t *range, double value) {
 __attribute__((noreturn)) static void usage(const char *name) {
   fprintf(stderr,
           "Usage: %s <-s socket> <-n value_spec> <-H hostname> [options]\n"
+          "       %s <-s socket> <-b file> [options]\n"
           "\n"
           "Valid options are:\n"
           "  -s <socket>    Path to collectd's UNIX-socket.\n"
@@ -249,6 +301,11 @@ __attribute__((noreturn)) static void usage(const char *name) {
           "  -w <range>     Warning range\n"
           "  -m             Treat \"Not a Number\" (NaN) as critical (default: "
           "warning)\n"
+          "  -b <file>      Run all checks listed in <file> (`-' for STDIN) "
+          "and print\n"
+          "                 the results as passive check results. -H, -c, "
+          "-w, -g, -d and\n"
+          "                 -m set the defaults for all checks.\n"
           "\n"
           "Consolidation functions:\n"
           "  none:          Apply the warning- and critical-ranges to each "
@@ -263,7 +320,7 @@ __attribute__((noreturn)) static void usage(const char *name) {
           "first value\n"
           "                 and the sum of all values."
           "\n",
-          name);
+          name, name);
   exit(1);
 } /* void usage */
 
@@ -294,7 +351,8 @@ static int do_listval(lcc_connection_t *connection) {
   for (size_t i = 0; i < ret_ident_num; ++i) {
     char id[1024];
 
-    if ((hostname_g != NULL) && (strcasecmp(hostname_g, ret_ident[i].host)))
+    if ((check_g.hostname != NULL) &&
+        (strcasecmp(check_g.hostname, ret_ident[i].host)))
       continue;
 
     if ((hostname == NULL) || strcasecmp(hostname, ret_ident[i].host)) {
@@ -326,7 +384,8 @@ static int do_listval(lcc_connection_t *connection) {
   return RET_OKAY;
 } /* int do_listval */
 
-static int do_check_con_none(size_t values_num, double *values,
+static int do_check_con_none(const check_t *check, FILE *out,
+                             size_t values_num, double *values,
                              char **values_names) {
   int num_critical = 0;
   int num_warning = 0;
@@ -336,20 +395,20 @@ static int do_check_con_none(size_t values_num, double *values,
 
   for (size_t i = 0; i < values_num; i++) {
     if (isnan(values[i])) {
-      if (nan_is_error_g)
+      if (check->nan_is_error)
         num_critical++;
       else
         num_warning++;
-    } else if (match_range(&range_critical_g, values[i]) != 0)
+    } else if (match_range(&check->range_critical, values[i]) != 0)
       num_critical++;
-    else if (match_range(&range_warning_g, values[i]) != 0)
+    else if (match_range(&check->range_warning, values[i]) != 0)
       num_warning++;
     else
       num_okay++;
   }
 
   if ((num_critical == 0) && (num_warning == 0) && (num_okay == 0)) {
-    printf("WARNING: No defined values found\n");
+    fprintf(out, "WARNING: No defined values found\n");
     return RET_WARNING;
   } else if ((num_critical == 0) && (num_warning == 0)) {
     status_str = "OKAY";
@@ -362,19 +421,20 @@ static int do_check_con_none(size_t values_num, double *values,
     status_code = RET_CRITICAL;
   }
 
-  printf("%s: %i critical, %i warning, %i okay", status_str, num_critical,
-         num_warning, num_okay);
+  fprintf(out, "%s: %i critical, %i warning, %i okay", status_str,
+          num_critical, num_warning, num_okay);
   if (values_num > 0) {
-    printf(" |");
+    fprintf(out, " |");
     for (size_t i = 0; i < values_num; i++)
-      printf(" %s=%f;;;;", values_names[i], values[i]);
+      fprintf(out, " %s=%f;;;;", values_names[i], values[i]);
   }
-  printf("\n");
+  fprintf(out, "\n");
 
   return status_code;
 } /* int do_check_con_none */
 
-static int do_check_con_average(size_t values_num, double *values,
+static int do_check_con_average(const check_t *check, FILE *out,
+                                size_t values_num, double *values,
                                 char **values_names) {
   double total;
   int total_num;
@@ -386,10 +446,11 @@ static int do_check_con_average(size_t values_num, double *values,
   total_num = 0;
   for (size_t i = 0; i < values_num; i++) {
     if (isnan(values[i])) {
-      if (!nan_is_error_g)
+      if (!check->nan_is_error)
         continue;
 
-      printf("CRITICAL: Data source \"%s\" is NaN\n", values_names[i]);
+      fprintf(out, "CRITICAL: Data source \"%s\" is NaN\n",
+              values_names[i]);
       return RET_CRITICAL;
     }
 
@@ -398,16 +459,16 @@ static int do_check_con_average(size_t values_num, double *values,
   }
 
   if (total_num == 0) {
-    printf("WARNING: No defined values found\n");
+    fprintf(out, "WARNING: No defined values found\n");
     return RET_WARNING;
   }
 
   average = total / total_num;
 
-  if (match_range(&range_critical_g, average) != 0) {
+  if (match_range(&check->range_critical, average) != 0) {
     status_str = "CRITICAL";
     status_code = RET_CRITICAL;
-  } else if (match_range(&range_warning_g, average) != 0) {
+  } else if (match_range(&check->range_warning, average) != 0) {
     status_str = "WARNING";
     status_code = RET_WARNING;
   } else {
@@ -415,15 +476,16 @@ static int do_check_con_average(size_t values_num, double *values,
     status_code = RET_OKAY;
   }
 
-  printf("%s: %g average |", status_str, average);
+  fprintf(out, "%s: %g average |", status_str, average);
   for (size_t i = 0; i < values_num; i++)
-    printf(" %s=%f;;;;", values_names[i], values[i]);
-  printf("\n");
+    fprintf(out, " %s=%f;;;;", values_names[i], values[i]);
+  fprintf(out, "\n");
 
   return status_code;
 } /* int do_check_con_average */
 
-static int do_check_con_sum(size_t values_num, double *values,
+static int do_check_con_sum(const check_t *check, FILE *out,
+                            size_t values_num, double *values,
                             char **values_names) {
   double total;
   int total_num;
@@ -434,10 +496,11 @@ static int do_check_con_sum(size_t values_num, double *values,
   total_num = 0;
   for (size_t i = 0; i < values_num; i++) {
     if (isnan(values[i])) {
-      if (!nan_is_error_g)
+      if (!check->nan_is_error)
         continue;
 
-      printf("CRITICAL: Data source \"%s\" is NaN\n", values_names[i]);
+      fprintf(out, "CRITICAL: Data source \"%s\" is NaN\n",
+              values_names[i]);
       return RET_CRITICAL;
     }
 
@@ -446,14 +509,14 @@ static int do_check_con_sum(size_t values_num, double *values,
   }
 
   if (total_num == 0) {
-    printf("WARNING: No defined values found\n");
+    fprintf(out, "WARNING: No defined values found\n");
     return RET_WARNING;
   }
 
-  if (match_range(&range_critical_g, total) != 0) {
+  if (match_range(&check->range_critical, total) != 0) {
     status_str = "CRITICAL";
     status_code = RET_CRITICAL;
-  } else if (match_range(&range_warning_g, total) != 0) {
+  } else if (match_range(&check->range_warning, total) != 0) {
     status_str = "WARNING";
     status_code = RET_WARNING;
   } else {
@@ -461,15 +524,16 @@ static int do_check_con_sum(size_t values_num, double *values,
     status_code = RET_OKAY;
   }
 
-  printf("%s: %g sum |", status_str, total);
+  fprintf(out, "%s: %g sum |", status_str, total);
   for (size_t i = 0; i < values_num; i++)
-    printf(" %s=%f;;;;", values_names[i], values[i]);
-  printf("\n");
+    fprintf(out, " %s=%f;;;;", values_names[i], values[i]);
+  fprintf(out, "\n");
 
   return status_code;
 } /* int do_check_con_sum */
 
-static int do_check_con_percentage(size_t values_num, double *values,
+static int do_check_con_percentage(const check_t *check, FILE *out,
+                                   size_t values_num, double *values,
                                    char **values_names) {
   double sum = 0.0;
   double percentage;
@@ -478,16 +542,17 @@ static int do_check_con_percentage(size_t values_num, double *values,
   int status_code = RET_UNKNOWN;
 
   if ((values_num < 1) || (isnan(values[0]))) {
-    printf("WARNING: The first value is not defined\n");
+    fprintf(out, "WARNING: The first value is not defined\n");
     return RET_WARNING;
   }
 
   for (size_t i = 0; i < values_num; i++) {
     if (isnan(values[i])) {
-      if (!nan_is_error_g)
+      if (!check->nan_is_error)
         continue;
 
-      printf("CRITICAL: Data source \"%s\" is NaN\n", values_names[i]);
+      fprintf(out, "CRITICAL: Data source \"%s\" is NaN\n",
+              values_names[i]);
       return RET_CRITICAL;
     }
 
@@ -495,16 +560,16 @@ static int do_check_con_percentage(size_t values_num, double *values,
   }
 
   if (sum == 0.0) {
-    printf("WARNING: Values sum up to zero\n");
+    fprintf(out, "WARNING: Values sum up to zero\n");
     return RET_WARNING;
   }
 
   percentage = 100.0 * values[0] / sum;
 
-  if (match_range(&range_critical_g, percentage) != 0) {
+  if (match_range(&check->range_critical, percentage) != 0) {
     status_str = "CRITICAL";
     status_code = RET_CRITICAL;
-  } else if (match_range(&range_warning_g, percentage) != 0) {
+  } else if (match_range(&check->range_warning, percentage) != 0) {
     status_str = "WARNING";
     status_code = RET_WARNING;
   } else {
@@ -512,12 +577,42 @@ static int do_check_con_percentage(size_t values_num, double *values,
     status_code = RET_OKAY;
   }
 
-  printf("%s: %lf percent |", status_str, percentage);
+  fprintf(out, "%s: %lf percent |", status_str, percentage);
   for (size_t i = 0; i < values_num; i++)
-    printf(" %s=%lf;;;;", values_names[i], values[i]);
+    fprintf(out, " %s=%lf;;;;", values_names[i], values[i]);
   return status_code;
 } /* int do_check_con_percentage */
 
+/* Rates the values of one check, writing the plugin output to `out'. Frees
+ * the values. */
+static int evaluate_check(const check_t *check, FILE *out, size_t values_num,
+                          gauge_t *values, char **values_names) {
+  int status;
+
+  status = filter_ds(check, out, &values_num, &values, &values_names);
+  if (status == RET_OKAY) {
+    status = RET_UNKNOWN;
+    if (check->consolitation == CON_NONE)
+      status = do_check_con_none(check, out, values_num, values, values_names);
+    else if (check->consolitation == CON_AVERAGE)
+      status =
+          do_check_con_average(check, out, values_num, values, values_names);
+    else if (check->consolitation == CON_SUM)
+      status = do_check_con_sum(check, out, values_num, values, values_names);
+    else if (check->consolitation == CON_PERCENTAGE)
+      status = do_check_con_percentage(check, out, values_num, values,
+                                       values_names);
+  }
+
+  free(values);
+  if (values_names != NULL)
+    for (size_t i = 0; i < values_num; i++)
+      free(values_names[i]);
+  free(values_names);
+
+  return status;
+} /* int evaluate_check */
+
 static int do_check(lcc_connection_t *connection) {
   gauge_t *values;
   char **values_names;
@@ -526,7 +621,8 @@ static int do_check(lcc_connection_t *connection) {
   lcc_identifier_t ident;
   int status;
 
-  snprintf(ident_str, sizeof(ident_str), "%s/%s", hostname_g, value_string_g);
+  snprintf(ident_str, sizeof(ident_str), "%s/%s", check_g.hostname,
+           check_g.value_string);
   ident_str[sizeof(ident_str) - 1] = '\0';
 
   status = lcc_string_to_identifier(connection, &ident, ident_str);
@@ -547,28 +643,308 @@ static int do_check(lcc_connection_t *connection) {
 
   LCC_DESTROY(connection);
 
-  status = filter_ds(&values_num, &values, &values_names);
-  if (status != RET_OKAY)
-    return status;
+  return evaluate_check(&check_g, stdout, values_num, values, values_names);
+} /* int do_check */
 
-  status = RET_UNKNOWN;
-  if (consolitation_g == CON_NONE)
-    status = do_check_con_none(values_num, values, values_names);
-  else if (consolitation_g == CON_AVERAGE)
-    status = do_check_con_average(values_num, values, values_names);
-  else if (consolitation_g == CON_SUM)
-    status = do_check_con_sum(values_num, values, values_names);
-  else if (consolitation_g == CON_PERCENTAGE)
-    status = do_check_con_percentage(values_num, values, values_names);
+static int parse_consolidation(const char *str) {
+  if (strcasecmp(str, "none") == 0)
+    return CON_NONE;
+  else if (strcasecmp(str, "average") == 0)
+    return CON_AVERAGE;
+  else if (strcasecmp(str, "sum") == 0)
+    return CON_SUM;
+  else if (strcasecmp(str, "percentage") == 0)
+    return CON_PERCENTAGE;
+  return -1;
+} /* int parse_consolidation */
+
+/* Splits `line' into white-space separated fields in place. Double quotes
+ * group fields containing white-space. Returns the number of fields or -1 if
+ * there are too many. */
+static int split_fields(char *line, char **fields, int fields_max) {
+  int fields_num = 0;
+  char *ptr = line;
+
+  while (*ptr != 0) {
+    while ((*ptr == ' ') || (*ptr == '\t'))
+      ptr++;
+    if (*ptr == 0)
+      break;
 
-  free(values);
-  if (values_names != NULL)
-    for (size_t i = 0; i < values_num; i++)
-      free(values_names[i]);
-  free(values_names);
+    if (fields_num >= fields_max)
+      return -1;
+
+    if (*ptr == '"') {
+      ptr++;
+      fields[fields_num++] = ptr;
+      while ((*ptr != 0) && (*ptr != '"'))
+        ptr++;
+    } else {
+      fields[fields_num++] = ptr;
+      while ((*ptr != 0) && (*ptr != ' ') && (*ptr != '\t'))
+        ptr++;
+    }
 
-  return status;
-} /* int do_check */
+    if (*ptr != 0) {
+      *ptr = 0;
+      ptr++;
+    }
+  }
+
+  return fields_num;
+} /* int split_fields */
+
+/* Parses one line of a batch file, e.g.
+ *   -H myhost -n load/load -w 5 -c 10 -D "Load average"
+ * into `check', which has been initialized from the command line except for
+ * the DSes. */
+static int parse_batch_line(char *line, check_t *check) {
+  char *fields[64];
+  int fields_num;
+  bool have_ds = false;
+
+  fields_num = split_fields(line, fields, 64);
+  if (fields_num < 0) {
+    fprintf(stderr, "Too many fields.\n");
+    return -1;
+  }
+
+  for (int i = 0; i < fields_num; i++) {
+    char *opt = fields[i];
+    char *arg = NULL;
+
+    if ((opt[0] != '-') || (opt[1] == 0) || (opt[2] != 0)) {
+      fprintf(stderr, "Unexpected field `%s'.\n", opt);
+      return -1;
+    }
+
+    if (opt[1] != 'm') {
+      if (i + 1 >= fields_num) {
+        fprintf(stderr, "Option `%s' requires an argument.\n", opt);
+        return -1;
+      }
+      arg = fields[++i];
+    }
+
+    switch (opt[1]) {
+    case 'c':
+      parse_range(arg, &check->range_critical);
+      break;
+    case 'w':
+      parse_range(arg, &check->range_warning);
+      break;
+    case 'n':
+      check->value_string = arg;
+      break;
+    case 'H':
+      check->hostname = arg;
+      break;
+    case 'D':
+      check->description = arg;
+      break;
+    case 'g':
+      check->consolitation = parse_consolidation(arg);
+      if (check->consolitation < 0) {
+        fprintf(stderr, "Unknown consolidation function `%s'.\n", arg);
+        return -1;
+      }
+      break;
+    case 'd':
+      if (check_add_ds(check, arg) != 0)
+        return -1;
+      have_ds = true;
+      break;
+    case 'm':
+      check->nan_is_error = true;
+      break;
+    default:
+      fprintf(stderr, "Unknown option `%s'.\n", opt);
+      return -1;
+    }
+  }
+
+  /* DSes given on the line replace those from the command line. */
+  if (!have_ds) {
+    for (size_t i = 0; i < check_g.match_ds_num; i++)
+      if (check_add_ds(check, check_g.match_ds[i]) != 0)
+        return -1;
+  }
+
+  if ((check->hostname == NULL) || (check->value_string == NULL)) {
+    fprintf(stderr, "Missing -H or -n.\n");
+    return -1;
+  }
+
+  if (check->description == NULL)
+    check->description = check->value_string;
+
+  return 0;
+} /* int parse_batch_line */
+
+/* Prints the result of a check in the format of Nagios' external command
+ * file, so the output can be written to the command pipe as is. */
+static void print_passive_result(const check_t *check, time_t now, int status,
+                                 char *output) {
+  /* The plugin output must be a single line. */
+  for (char *ptr = output; *ptr != 0; ptr++)
+    if ((*ptr == '\n') || (*ptr == '\r'))
+      *ptr = ' ';
+  for (size_t len = strlen(output); (len > 0) && (output[len - 1] == ' ');
+       len--)
+    output[len - 1] = 0;
+
+  printf("[%lld] PROCESS_SERVICE_CHECK_RESULT;%s;%s;%i;%s\n", (long long)now,
+         check->hostname, check->description, status, output);
+} /* void print_passive_result */
+
+/* Runs all checks listed in `batch_file_g'. The values of all checks are
+ * retrieved over a single connection with as few GETVALS commands as
+ * possible. */
+static int do_batch(lcc_connection_t *connection) {
+  FILE *fh;
+  char **lines = NULL;
+  check_t *checks = NULL;
+  size_t checks_num = 0;
+  size_t checks_size = 0;
+  char buffer[4096];
+  int line_num = 0;
+  int ret = RET_OKAY;
+
+  if (strcmp(batch_file_g, "-") == 0)
+    fh = stdin;
+  else
+    fh = fopen(batch_file_g, "r");
+  if (fh == NULL) {
+    fprintf(stderr, "Opening `%s' failed: %s\n", batch_file_g,
+            strerror(errno));
+    LCC_DESTROY(connection);
+    return RET_UNKNOWN;
+  }
+
+  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
+    char *ptr = buffer;
+
+    line_num++;
+    buffer[strcspn(buffer, "\r\n")] = 0;
+    while ((*ptr == ' ') || (*ptr == '\t'))
+      ptr++;
+    if ((*ptr == 0) || (*ptr == '#'))
+      continue;
+
+    if (checks_num == checks_size) {
+      size_t new_size = (checks_size > 0) ? 2 * checks_size : 64;
+      check_t *tmp_checks = realloc(checks, new_size * sizeof(*checks));
+      if (tmp_checks != NULL)
+        checks = tmp_checks;
+      char **tmp_lines = realloc(lines, new_size * sizeof(*lines));
+      if (tmp_lines != NULL)
+        lines = tmp_lines;
+      if ((tmp_checks == NULL) || (tmp_lines == NULL)) {
+        fprintf(stderr, "realloc failed: %s\n", strerror(errno));
+        ret = RET_UNKNOWN;
+        break;
+      }
+      checks_size = new_size;
+    }
+
+    /* The check keeps pointers into its line. */
+    lines[checks_num] = cn_strdup(ptr);
+    if (lines[checks_num] == NULL) {
+      fprintf(stderr, "cn_strdup failed: %s\n", strerror(errno));
+      ret = RET_UNKNOWN;
+      break;
+    }
+
+    checks[checks_num] = check_g;
+    checks[checks_num].match_ds = NULL;
+    checks[checks_num].match_ds_num = 0;
+    if (parse_batch_line(lines[checks_num], checks + checks_num) != 0) {
+      fprintf(stderr, "%s:%i: Ignoring invalid check.\n", batch_file_g,
+              line_num);
+      check_destroy(checks + checks_num);
+      free(lines[checks_num]);
+      ret = RET_UNKNOWN;
+      continue;
+    }
+    checks_num++;
+  }
+  if (fh != stdin)
+    fclose(fh);
+
+  lcc_identifier_t *idents = calloc(checks_num + 1, sizeof(*idents));
+  /* Index of each check's identifier in `idents', or -1 if it is invalid. */
+  ssize_t *ident_index = calloc(checks_num + 1, sizeof(*ident_index));
+  lcc_getvals_result_t *results = NULL;
+  size_t idents_num = 0;
+  time_t now = time(NULL);
+
+  if ((idents == NULL) || (ident_index == NULL)) {
+    fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+    ret = RET_UNKNOWN;
+  } else {
+    for (size_t i = 0; i < checks_num; i++) {
+      char ident_str[1024];
+
+      snprintf(ident_str, sizeof(ident_str), "%s/%s", checks[i].hostname,
+               checks[i].value_string);
+      if (lcc_string_to_identifier(connection, idents + idents_num,
+                                   ident_str) != 0) {
+        ident_index[i] = -1;
+        continue;
+      }
+      ident_index[i] = (ssize_t)idents_num;
+      idents_num++;
+    }
+
+    if (lcc_getvals(connection, idents, idents_num, &results) != 0) {
+      printf("ERROR: Retrieving values from the daemon failed: %s.\n",
+             lcc_strerror(connection));
+      ret = RET_CRITICAL;
+    }
+  }
+  LCC_DESTROY(connection);
+
+  for (size_t i = 0; (results != NULL) && (i < checks_num); i++) {
+    char *output = NULL;
+    size_t output_size = 0;
+    int status;
+
+    FILE *out = open_memstream(&output, &output_size);
+    if (out == NULL) {
+      fprintf(stderr, "open_memstream failed: %s\n", strerror(errno));
+      ret = RET_UNKNOWN;
+      break;
+    }
+
+    if (ident_index[i] < 0) {
+      fprintf(out, "ERROR: Creating an identifier failed.");
+      status = RET_UNKNOWN;
+    } else {
+      /* evaluate_check() takes ownership of the values. */
+      lcc_getvals_result_t *res = results + ident_index[i];
+      status = evaluate_check(checks + i, out, res->values_num, res->values,
+                              res->values_names);
+      res->values = NULL;
+      res->values_names = NULL;
+      res->values_num = 0;
+    }
+    fclose(out);
+
+    print_passive_result(checks + i, now, status, output);
+    free(output);
+  }
+
+  lcc_getvals_free(results, idents_num);
+  free(ident_index);
+  free(idents);
+  for (size_t i = 0; i < checks_num; i++) {
+    check_destroy(checks + i);
+    free(lines[i]);
+  }
+  free(checks);
+  free(lines);
+  return ret;
+} /* int do_batch */
 
 int main(int argc, char **argv) {
   char address[1024];
@@ -576,77 +952,58 @@ int main(int argc, char **argv) {
 
   int status;
 
-  range_critical_g.min = NAN;
-  range_critical_g.max = NAN;
-  range_critical_g.invert = 0;
-
-  range_warning_g.min = NAN;
-  range_warning_g.max = NAN;
-  range_warning_g.invert = 0;
+  check_init(&check_g);
 
   while (42) {
     int c;
 
-    c = getopt(argc, argv, "w:c:s:n:H:g:d:hm");
+    c = getopt(argc, argv, "w:c:s:n:H:g:d:b:hm");
     if (c < 0)
       break;
 
     switch (c) {
     case 'c':
-      parse_range(optarg, &range_critical_g);
+      parse_range(optarg, &check_g.range_critical);
       break;
     case 'w':
-      parse_range(optarg, &range_warning_g);
+      parse_range(optarg, &check_g.range_warning);
       break;
     case 's':
       socket_file_g = optarg;
       break;
     case 'n':
-      value_string_g = optarg;
+      check_g.value_string = optarg;
       break;
     case 'H':
-      hostname_g = optarg;
+      check_g.hostname = optarg;
+      break;
+    case 'b':
+      batch_file_g = optarg;
       break;
     case 'g':
-      if (strcasecmp(optarg, "none") == 0)
-        consolitation_g = CON_NONE;
-      else if (strcasecmp(optarg, "average") == 0)
-        consolitation_g = CON_AVERAGE;
-      else if (strcasecmp(optarg, "sum") == 0)
-        consolitation_g = CON_SUM;
-      else if (strcasecmp(optarg, "percentage") == 0)
-        consolitation_g = CON_PERCENTAGE;
-      else {
+      check_g.consolitation = parse_consolidation(optarg);
+      if (check_g.consolitation < 0) {
         fprintf(stderr, "Unknown consolidation function `%s'.\n", optarg);
         usage(argv[0]);
       }
       break;
-    case 'd': {
-      char **tmp;
-      tmp = realloc(match_ds_g, (match_ds_num_g + 1) * sizeof(char *));
-      if (tmp == NULL) {
-        fprintf(stderr, "realloc failed: %s\n", strerror(errno));
-        return RET_UNKNOWN;
-      }
-      match_ds_g = tmp;
-      match_ds_g[match_ds_num_g] = cn_strdup(optarg);
-      if (match_ds_g[match_ds_num_g] == NULL) {
-        fprintf(stderr, "cn_strdup failed: %s\n", strerror(errno));
+    case 'd':
+      if (check_add_ds(&check_g, optarg) != 0)
         return RET_UNKNOWN;
-      }
-      match_ds_num_g++;
       break;
-    }
     case 'm':
-      nan_is_error_g = true;
+      check_g.nan_is_error = true;
       break;
     default:
       usage(argv[0]);
     } /* switch (c) */
   }
 
-  if ((socket_file_g == NULL) || (value_string_g == NULL) ||
-      ((hostname_g == NULL) && (strcasecmp(value_string_g, "LIST")))) {
+  if ((socket_file_g == NULL) ||
+      ((batch_file_g == NULL) &&
+       ((check_g.value_string == NULL) ||
+        ((check_g.hostname == NULL) &&
+         (strcasecmp(check_g.value_string, "LIST")))))) {
     fprintf(stderr, "Missing required arguments.\n");
     usage(argv[0]);
   }
@@ -661,7 +1018,10 @@ int main(int argc, char **argv) {
     return RET_CRITICAL;
   }
 
-  if (0 == strcasecmp(value_string_g, "LIST"))
+  if (batch_file_g != NULL)
+    return do_batch(connection);
+
+  if (0 == strcasecmp(check_g.value_string, "LIST"))
     return do_listval(connection);
 
   return do_check(connection);
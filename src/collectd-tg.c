@@ -24,6 +24,8 @@
  *   Florian Forster <octo at collectd.org>
  **/
 
+#define _GNU_SOURCE /* For sendmmsg(2) */
+
 #if HAVE_CONFIG_H
 #include "config.h"
 #endif
@@ -33,13 +35,20 @@
 #endif
 
 #include <errno.h>
+#include <inttypes.h>
 #include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -47,11 +56,18 @@
 
 #include "collectd/client.h"
 #include "collectd/network.h"
+#include "collectd/network_buffer.h"
 
 #define DEF_NUM_HOSTS 1000
 #define DEF_NUM_PLUGINS 20
 #define DEF_NUM_VALUES 100000
 #define DEF_INTERVAL 10.0
+#define DEF_NUM_THREADS 1
+#define DEF_TTL 42
+
+/* Number of packets a sender thread collects before sending them with a
+ * single sendmmsg(2) call. */
+#define SEND_BATCH_SIZE 32
 
 static int conf_num_hosts = DEF_NUM_HOSTS;
 static int conf_num_plugins = DEF_NUM_PLUGINS;
@@ -59,6 +75,16 @@ static int conf_num_values = DEF_NUM_VALUES;
 static double conf_interval = DEF_INTERVAL;
 static const char *conf_destination = NET_DEFAULT_V6_ADDR;
 static const char *conf_service = NET_DEFAULT_PORT;
+/* If greater than zero, values are sent at this rate (values per second)
+ * rather than once per interval, see run_paced(). */
+static double conf_rate;
+static int conf_num_threads = DEF_NUM_THREADS;
+static double conf_zipf_exponent;
+static double conf_duration;
+static lcc_security_level_t conf_security_level = NONE;
+static const char *conf_username;
+static const char *conf_password;
+static bool conf_compress;
 
 static lcc_network_t *net;
 
@@ -67,7 +93,7 @@ static c_heap_t *values_heap;
 static struct sigaction sigint_action;
 static struct sigaction sigterm_action;
 
-static bool loop = true;
+static volatile bool loop = true;
 
 __attribute__((noreturn)) static void exit_usage(int exit_status) /* {{{ */
 {
@@ -86,12 +112,23 @@ __attribute__((noreturn)) static void exit_usage(int exit_status) /* {{{ */
       "                   (Default: %s)\n"
       "    -D <port>      Destination port of the network packets.\n"
       "                   (Default: %s)\n"
+      "    -r <rate>      Send values at this rate (values per second)\n"
+      "                   instead of once per interval. (Default: off)\n"
+      "    -t <number>    Number of sender threads with -r. (Default: %i)\n"
+      "    -z <exponent>  Choose value lists from a Zipf distribution with\n"
+      "                   this exponent with -r. (Default: 0, uniform)\n"
+      "    -T <seconds>   Stop after this many seconds. (Default: never)\n"
+      "    -l <level>     Security level, \"sign\" or \"encrypt\".\n"
+      "                   (Default: none)\n"
+      "    -u <username>  Username used to sign or encrypt packets.\n"
+      "    -P <password>  Password used to sign or encrypt packets.\n"
+      "    -c             Compress the packets.\n"
       "    -h             Print usage information (this output).\n"
       "\n"
       "Copyright (C) 2010-2012  Florian Forster\n"
       "Licensed under the MIT license.\n",
       DEF_NUM_VALUES, DEF_NUM_HOSTS, DEF_NUM_PLUGINS, DEF_INTERVAL,
-      NET_DEFAULT_V6_ADDR, NET_DEFAULT_PORT);
+      NET_DEFAULT_V6_ADDR, NET_DEFAULT_PORT, DEF_NUM_THREADS);
   exit(exit_status);
 } /* }}} void exit_usage */
 
@@ -232,6 +269,432 @@ static int send_value(lcc_value_list_t *vl) /* {{{ */
   return 0;
 } /* }}} int send_value */
 
+/*
+ * Paced mode
+ *
+ * Each sender thread owns every n-th value list, so that the values of a
+ * value list are sent in order, and its own socket and network buffer. It
+ * sends its share of the target rate, paced by a token bucket, and collects
+ * full packets so it can send several of them with one system call.
+ */
+typedef struct {
+  lcc_value_list_t **vls;
+  int vls_num;
+  /* Cumulative distribution used to choose a value list, or NULL to choose
+   * them uniformly. */
+  double *cdf;
+  uint64_t random_state;
+  double rate;
+
+  int fd;
+  lcc_network_buffer_t *buffer;
+  int buffer_values;
+
+  char packets[SEND_BATCH_SIZE][LCC_NETWORK_BUFFER_SIZE_DEFAULT];
+  size_t packets_size[SEND_BATCH_SIZE];
+  int packets_num;
+
+  uint64_t values_sent;
+  uint64_t packets_sent;
+  uint64_t bytes_sent;
+  uint64_t send_errors;
+
+  pthread_t thread;
+} sender_t;
+
+/* xorshift64*, so that the threads don't contend on random(3). */
+static double sender_random(sender_t *s) /* {{{ */
+{
+  s->random_state ^= s->random_state >> 12;
+  s->random_state ^= s->random_state << 25;
+  s->random_state ^= s->random_state >> 27;
+  uint64_t r = s->random_state * UINT64_C(2685821657736338717);
+
+  return (double)(r >> 11) / 9007199254740992.0; /* 2^53 */
+} /* }}} double sender_random */
+
+/* Returns the cumulative distribution of a Zipf distribution over `num'
+ * ranks, i.e. the probability of rank k is proportional to 1 / k^exponent. */
+static double *zipf_cdf_create(int num, double exponent) /* {{{ */
+{
+  double *cdf = calloc((size_t)num, sizeof(*cdf));
+  if (cdf == NULL)
+    return NULL;
+
+  double sum = 0.0;
+  for (int i = 0; i < num; i++) {
+    sum += 1.0 / pow((double)(i + 1), exponent);
+    cdf[i] = sum;
+  }
+  for (int i = 0; i < num; i++)
+    cdf[i] /= sum;
+
+  return cdf;
+} /* }}} double *zipf_cdf_create */
+
+static lcc_value_list_t *sender_choose(sender_t *s) /* {{{ */
+{
+  double r = sender_random(s);
+
+  if (s->cdf == NULL)
+    return s->vls[(int)(r * (double)s->vls_num)];
+
+  /* Binary search for the first rank with cdf >= r. */
+  int lo = 0;
+  int hi = s->vls_num - 1;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (s->cdf[mid] < r)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return s->vls[lo];
+} /* }}} lcc_value_list_t *sender_choose */
+
+static int sender_open_socket(sender_t *s) /* {{{ */
+{
+  struct addrinfo *ai_list;
+  struct addrinfo ai_hints = {.ai_family = AF_UNSPEC,
+                              .ai_flags = AI_ADDRCONFIG,
+                              .ai_socktype = SOCK_DGRAM};
+
+  int status = getaddrinfo(conf_destination, conf_service, &ai_hints, &ai_list);
+  if (status != 0) {
+    fprintf(stderr, "getaddrinfo(\"%s\", \"%s\") failed: %s\n",
+            conf_destination, conf_service, gai_strerror(status));
+    return -1;
+  }
+
+  s->fd = -1;
+  for (struct addrinfo *ai = ai_list; ai != NULL; ai = ai->ai_next) {
+    int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0)
+      continue;
+
+    int ttl = DEF_TTL;
+    if (ai->ai_family == AF_INET) {
+      struct sockaddr_in *addr = (struct sockaddr_in *)ai->ai_addr;
+      int optname = IN_MULTICAST(ntohl(addr->sin_addr.s_addr))
+                        ? IP_MULTICAST_TTL
+                        : IP_TTL;
+      setsockopt(fd, IPPROTO_IP, optname, &ttl, sizeof(ttl));
+    } else if (ai->ai_family == AF_INET6) {
+      struct sockaddr_in6 *addr = (struct sockaddr_in6 *)ai->ai_addr;
+      int optname = IN6_IS_ADDR_MULTICAST(&addr->sin6_addr)
+                        ? IPV6_MULTICAST_HOPS
+                        : IPV6_UNICAST_HOPS;
+      setsockopt(fd, IPPROTO_IPV6, optname, &ttl, sizeof(ttl));
+    }
+
+    /* Connecting lets us omit the address when sending. */
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+      close(fd);
+      continue;
+    }
+
+    s->fd = fd;
+    break;
+  }
+
+  freeaddrinfo(ai_list);
+
+  if (s->fd < 0) {
+    fprintf(stderr, "Unable to open a socket to \"%s\", port \"%s\".\n",
+            conf_destination, conf_service);
+    return -1;
+  }
+  return 0;
+} /* }}} int sender_open_socket */
+
+/* Sends all collected packets. */
+static void sender_flush(sender_t *s) /* {{{ */
+{
+  int sent = 0;
+
+#if HAVE_SENDMMSG
+  struct mmsghdr msgs[SEND_BATCH_SIZE] = {0};
+  struct iovec iovs[SEND_BATCH_SIZE];
+
+  for (int i = 0; i < s->packets_num; i++) {
+    iovs[i] = (struct iovec){
+        .iov_base = s->packets[i],
+        .iov_len = s->packets_size[i],
+    };
+    msgs[i].msg_hdr.msg_iov = iovs + i;
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  while (sent < s->packets_num) {
+    int status = sendmmsg(s->fd, msgs + sent,
+                          (unsigned int)(s->packets_num - sent), /* flags = */ 0);
+    if (status < 0) {
+      if ((errno == EINTR) || (errno == EAGAIN))
+        continue;
+      /* Skip the packet that failed. */
+      s->send_errors++;
+      sent++;
+      continue;
+    }
+
+    for (int i = sent; i < sent + status; i++) {
+      s->packets_sent++;
+      s->bytes_sent += s->packets_size[i];
+    }
+    sent += status;
+  }
+#else
+  for (; sent < s->packets_num; sent++) {
+    ssize_t status;
+    do {
+      status = send(s->fd, s->packets[sent], s->packets_size[sent],
+                    /* flags = */ 0);
+    } while ((status < 0) && ((errno == EINTR) || (errno == EAGAIN)));
+
+    if (status < 0) {
+      s->send_errors++;
+      continue;
+    }
+    s->packets_sent++;
+    s->bytes_sent += s->packets_size[sent];
+  }
+#endif
+
+  s->packets_num = 0;
+} /* }}} void sender_flush */
+
+/* Moves the network buffer into the batch of packets to send. */
+static void sender_finish_packet(sender_t *s) /* {{{ */
+{
+  if (s->buffer_values == 0)
+    return;
+
+  int status = lcc_network_buffer_finalize(s->buffer);
+  if (status == 0) {
+    size_t size = sizeof(s->packets[0]);
+    status = lcc_network_buffer_get(s->buffer, s->packets[s->packets_num],
+                                    &size);
+    if ((status == 0) && (size <= sizeof(s->packets[0]))) {
+      s->packets_size[s->packets_num] = size;
+      s->packets_num++;
+    }
+  }
+  if (status != 0)
+    s->send_errors++;
+
+  lcc_network_buffer_initialize(s->buffer);
+  s->buffer_values = 0;
+
+  if (s->packets_num == SEND_BATCH_SIZE)
+    sender_flush(s);
+} /* }}} void sender_finish_packet */
+
+static void sender_add_value(sender_t *s, lcc_value_list_t *vl) /* {{{ */
+{
+  if (lcc_network_buffer_add_value(s->buffer, vl) != 0) {
+    sender_finish_packet(s);
+    if (lcc_network_buffer_add_value(s->buffer, vl) != 0) {
+      s->send_errors++;
+      return;
+    }
+  }
+
+  s->buffer_values++;
+  s->values_sent++;
+} /* }}} void sender_add_value */
+
+static void *sender_thread(void *arg) /* {{{ */
+{
+  sender_t *s = arg;
+
+  /* Allow a burst of 10ms worth of values, but at least one. */
+  double burst = s->rate / 100.0;
+  if (burst < 1.0)
+    burst = 1.0;
+
+  double start = dtime();
+  double last = start;
+  double tokens = 0.0;
+
+  while (loop) {
+    double now = dtime();
+    if ((conf_duration > 0.0) && ((now - start) >= conf_duration))
+      break;
+
+    tokens += (now - last) * s->rate;
+    last = now;
+    if (tokens > burst)
+      tokens = burst;
+
+    if (tokens < 1.0) {
+      /* Don't hold back values while waiting for tokens. Waiting for a full
+       * burst keeps packets from being sent half empty. */
+      sender_finish_packet(s);
+      sender_flush(s);
+
+      double wait = (burst - tokens) / s->rate;
+      struct timespec ts = {
+          .tv_sec = (time_t)wait,
+      };
+      ts.tv_nsec = (long)((wait - ((double)ts.tv_sec)) * 1e9);
+      nanosleep(&ts, /* remaining = */ NULL);
+      continue;
+    }
+
+    for (; tokens >= 1.0; tokens -= 1.0) {
+      lcc_value_list_t *vl = sender_choose(s);
+
+      if (vl->values_types[0] == LCC_TYPE_GAUGE)
+        vl->values[0].gauge = 100.0 * sender_random(s);
+      else
+        vl->values[0].derive += (derive_t)(100.0 * sender_random(s));
+
+      /* The time must increase even if a value list is chosen repeatedly
+       * within the clock's resolution. */
+      vl->time = (now > vl->time) ? now : vl->time + 1e-6;
+
+      sender_add_value(s, vl);
+    }
+  }
+
+  sender_finish_packet(s);
+  sender_flush(s);
+  return NULL;
+} /* }}} void *sender_thread */
+
+static int sender_init(sender_t *s, int index) /* {{{ */
+{
+  s->random_state = ((uint64_t)random() << 32) ^ (uint64_t)random() ^
+                    (uint64_t)(index + 1);
+  s->rate = conf_rate / (double)conf_num_threads;
+
+  s->vls_num = 0;
+  s->vls = calloc((size_t)(conf_num_values / conf_num_threads + 1),
+                  sizeof(*s->vls));
+  if (s->vls == NULL)
+    return -1;
+
+  for (int i = index; i < conf_num_values; i += conf_num_threads) {
+    lcc_value_list_t *vl = create_value_list();
+    if (vl == NULL)
+      return -1;
+    vl->time = 0.0;
+    s->vls[s->vls_num] = vl;
+    s->vls_num++;
+  }
+
+  if (conf_zipf_exponent > 0.0) {
+    s->cdf = zipf_cdf_create(s->vls_num, conf_zipf_exponent);
+    if (s->cdf == NULL)
+      return -1;
+  }
+
+  s->buffer = lcc_network_buffer_create(LCC_NETWORK_BUFFER_SIZE_DEFAULT);
+  if (s->buffer == NULL)
+    return -1;
+  if (conf_security_level != NONE) {
+    int status = lcc_network_buffer_set_security_level(
+        s->buffer, conf_security_level, conf_username, conf_password);
+    if (status != 0) {
+      fprintf(stderr, "Setting the security level failed with status %i.\n",
+              status);
+      return -1;
+    }
+  }
+  if (conf_compress) {
+    int status = lcc_network_buffer_set_compression(s->buffer, 1);
+    if (status != 0) {
+      fprintf(stderr, "Enabling compression failed with status %i.\n",
+              status);
+      return -1;
+    }
+  }
+  lcc_network_buffer_initialize(s->buffer);
+
+  return sender_open_socket(s);
+} /* }}} int sender_init */
+
+static void sender_destroy(sender_t *s) /* {{{ */
+{
+  if (s->vls != NULL) {
+    for (int i = 0; i < s->vls_num; i++)
+      destroy_value_list(s->vls[i]);
+  }
+  free(s->vls);
+  free(s->cdf);
+  if (s->buffer != NULL)
+    lcc_network_buffer_destroy(s->buffer);
+  if (s->fd >= 0)
+    close(s->fd);
+} /* }}} void sender_destroy */
+
+static void print_summary(double elapsed, uint64_t values_sent, /* {{{ */
+                          uint64_t packets_sent, uint64_t bytes_sent,
+                          uint64_t send_errors) {
+  if (elapsed <= 0.0)
+    elapsed = 1e-9;
+
+  printf("Sent %" PRIu64 " values in %.3f seconds: %.1f values/s", values_sent,
+         elapsed, (double)values_sent / elapsed);
+  if (packets_sent > 0)
+    printf(", %" PRIu64 " packets (%.1f packets/s, %.3f MBit/s)", packets_sent,
+           (double)packets_sent / elapsed,
+           8.0 * (double)bytes_sent / elapsed / 1e6);
+  if (send_errors > 0)
+    printf(", %" PRIu64 " errors", send_errors);
+  printf(".\n");
+} /* }}} void print_summary */
+
+static int run_paced(void) /* {{{ */
+{
+  sender_t *senders = calloc((size_t)conf_num_threads, sizeof(*senders));
+  if (senders == NULL) {
+    fprintf(stderr, "calloc failed.\n");
+    return -1;
+  }
+  for (int i = 0; i < conf_num_threads; i++)
+    senders[i].fd = -1;
+
+  int status = 0;
+  fprintf(stdout, "Creating %i values ... ", conf_num_values);
+  fflush(stdout);
+  for (int i = 0; (status == 0) && (i < conf_num_threads); i++)
+    status = sender_init(senders + i, i);
+  fprintf(stdout, (status == 0) ? "done\n" : "failed\n");
+
+  int threads_num = 0;
+  double start = dtime();
+  for (; (status == 0) && (threads_num < conf_num_threads); threads_num++) {
+    status = pthread_create(&senders[threads_num].thread, /* attr = */ NULL,
+                            sender_thread, senders + threads_num);
+    if (status != 0) {
+      fprintf(stderr, "pthread_create failed: %s\n", strerror(status));
+      break;
+    }
+  }
+
+  uint64_t values_sent = 0;
+  uint64_t packets_sent = 0;
+  uint64_t bytes_sent = 0;
+  uint64_t send_errors = 0;
+  for (int i = 0; i < threads_num; i++) {
+    pthread_join(senders[i].thread, /* retval = */ NULL);
+    values_sent += senders[i].values_sent;
+    packets_sent += senders[i].packets_sent;
+    bytes_sent += senders[i].bytes_sent;
+    send_errors += senders[i].send_errors;
+  }
+  if (threads_num > 0)
+    print_summary(dtime() - start, values_sent, packets_sent, bytes_sent,
+                  send_errors);
+
+  for (int i = 0; i < conf_num_threads; i++)
+    sender_destroy(senders + i);
+  free(senders);
+
+  return (status == 0) ? 0 : -1;
+} /* }}} int run_paced */
+
 static int get_integer_opt(const char *str, int *ret_value) /* {{{ */
 {
   char *endptr;
@@ -284,7 +747,7 @@ static int read_options(int argc, char **argv) /* {{{ */
 {
   int opt;
 
-  while ((opt = getopt(argc, argv, "n:H:p:i:d:D:h")) != -1) {
+  while ((opt = getopt(argc, argv, "n:H:p:i:d:D:r:t:z:T:l:u:P:ch")) != -1) {
     switch (opt) {
     case 'n':
       get_integer_opt(optarg, &conf_num_values);
@@ -310,6 +773,47 @@ static int read_options(int argc, char **argv) /* {{{ */
       conf_service = optarg;
       break;
 
+    case 'r':
+      get_double_opt(optarg, &conf_rate);
+      break;
+
+    case 't':
+      get_integer_opt(optarg, &conf_num_threads);
+      break;
+
+    case 'z':
+      get_double_opt(optarg, &conf_zipf_exponent);
+      break;
+
+    case 'T':
+      get_double_opt(optarg, &conf_duration);
+      break;
+
+    case 'l':
+      if (strcasecmp("sign", optarg) == 0)
+        conf_security_level = SIGN;
+      else if (strcasecmp("encrypt", optarg) == 0)
+        conf_security_level = ENCRYPT;
+      else if (strcasecmp("none", optarg) == 0)
+        conf_security_level = NONE;
+      else {
+        fprintf(stderr, "Invalid security level: \"%s\"\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+
+    case 'u':
+      conf_username = optarg;
+      break;
+
+    case 'P':
+      conf_password = optarg;
+      break;
+
+    case 'c':
+      conf_compress = true;
+      break;
+
     case 'h':
       exit_usage(EXIT_SUCCESS);
 
@@ -318,6 +822,23 @@ static int read_options(int argc, char **argv) /* {{{ */
     } /* switch (opt) */
   }   /* while (getopt) */
 
+  if ((conf_num_values < 1) || (conf_num_hosts < 1) || (conf_num_plugins < 1) ||
+      (conf_num_threads < 1) || (conf_rate < 0.0) ||
+      (conf_zipf_exponent < 0.0) || (conf_duration < 0.0)) {
+    fprintf(stderr, "Invalid arguments.\n");
+    exit_usage(EXIT_FAILURE);
+  }
+
+  if ((conf_security_level != NONE) &&
+      ((conf_username == NULL) || (conf_password == NULL))) {
+    fprintf(stderr, "Signing and encryption require a username (-u) and a "
+                    "password (-P).\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if (conf_num_threads > conf_num_values)
+    conf_num_threads = conf_num_values;
+
   return 0;
 } /* }}} int read_options */
 
@@ -334,6 +855,9 @@ int main(int argc, char **argv) /* {{{ */
   sigterm_action.sa_handler = signal_handler;
   sigaction(SIGTERM, &sigterm_action, /* old = */ NULL);
 
+  if (conf_rate > 0.0)
+    exit((run_paced() == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
+
   values_heap = c_heap_create(compare_time);
   if (values_heap == NULL) {
     fprintf(stderr, "c_heap_create failed.\n");
@@ -353,11 +877,25 @@ int main(int argc, char **argv) /* {{{ */
       exit(EXIT_FAILURE);
     }
 
-    lcc_server_set_ttl(srv, 42);
-#if 0
-    lcc_server_set_security_level (srv, ENCRYPT,
-        "admin", "password1");
-#endif
+    lcc_server_set_ttl(srv, DEF_TTL);
+    if (conf_security_level != NONE) {
+      int status = lcc_server_set_security_level(srv, conf_security_level,
+                                                 conf_username, conf_password);
+      if (status != 0) {
+        fprintf(stderr, "lcc_server_set_security_level failed with status "
+                        "%i.\n",
+                status);
+        exit(EXIT_FAILURE);
+      }
+    }
+    if (conf_compress) {
+      int status = lcc_server_set_compression(srv, 1);
+      if (status != 0) {
+        fprintf(stderr, "lcc_server_set_compression failed with status %i.\n",
+                status);
+        exit(EXIT_FAILURE);
+      }
+    }
   }
 
   fprintf(stdout, "Creating %i values ... ", conf_num_values);
@@ -375,6 +913,7 @@ int main(int argc, char **argv) /* {{{ */
   }
   fprintf(stdout, "done\n");
 
+  double start_time = dtime();
   last_time = 0;
   while (loop) {
     lcc_value_list_t *vl = c_heap_get_root(values_heap);
@@ -382,6 +921,11 @@ int main(int argc, char **argv) /* {{{ */
     if (vl == NULL)
       break;
 
+    if ((conf_duration > 0.0) && ((dtime() - start_time) >= conf_duration)) {
+      c_heap_insert(values_heap, vl);
+      break;
+    }
+
     if (vl->time != last_time) {
       printf("%i values have been sent.\n", values_sent);
 
@@ -411,6 +955,9 @@ int main(int argc, char **argv) /* {{{ */
   }
 
   fprintf(stdout, "Shutting down.\n");
+  print_summary(dtime() - start_time, (uint64_t)values_sent,
+                /* packets_sent = */ 0, /* bytes_sent = */ 0,
+                /* send_errors = */ 0);
   fflush(stdout);
 
   while (42) {
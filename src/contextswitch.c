@@ -32,7 +32,9 @@
 /* #endif HAVE_SYSCTLBYNAME */
 
 #elif KERNEL_LINUX
-/* no global variables */
+#include "utils/procfs/procfs.h"
+
+static cu_procfs_t *proc_stat;
 /* #endif KERNEL_LINUX */
 
 #elif HAVE_PERFSTAT
@@ -73,46 +75,26 @@ static int cs_read(void) {
   /* #endif HAVE_SYSCTLBYNAME */
 
 #elif KERNEL_LINUX
-  FILE *fh;
-  char buffer[64];
-  int numfields;
-  char *fields[3];
-  derive_t result = 0;
-  int status = -2;
-
-  fh = fopen("/proc/stat", "r");
-  if (fh == NULL) {
+  cu_procfs_key_t key = {.key = "ctxt"};
+  int status = 0;
+
+  if ((proc_stat == NULL) &&
+      ((proc_stat = cu_procfs_open("/proc/stat")) == NULL)) {
     ERROR("contextswitch plugin: unable to open /proc/stat: %s", STRERRNO);
     return -1;
   }
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
-    char *endptr;
-
-    numfields = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
-    if (numfields != 2)
-      continue;
-
-    if (strcmp("ctxt", fields[0]) != 0)
-      continue;
-
-    errno = 0;
-    endptr = NULL;
-    result = (derive_t)strtoll(fields[1], &endptr, /* base = */ 10);
-    if ((endptr == fields[1]) || (errno != 0)) {
-      ERROR("contextswitch plugin: Cannot parse ctxt value: %s", fields[1]);
-      status = -1;
-      break;
-    }
-
-    cs_submit(result);
-    status = 0;
-    break;
+  if (cu_procfs_read_keys(proc_stat, &key, 1) < 0) {
+    ERROR("contextswitch plugin: reading /proc/stat failed: %s", STRERRNO);
+    return -1;
   }
-  fclose(fh);
 
-  if (status == -2)
+  if (key.found) {
+    cs_submit((derive_t)key.value);
+  } else {
     ERROR("contextswitch plugin: Unable to find context switch value.");
+    status = -1;
+  }
     /* #endif  KERNEL_LINUX */
 
 #elif HAVE_PERFSTAT
@@ -133,6 +115,17 @@ static int cs_read(void) {
   return status;
 }
 
+#if KERNEL_LINUX
+static int cs_shutdown(void) {
+  cu_procfs_close(proc_stat);
+  proc_stat = NULL;
+  return 0;
+}
+#endif
+
 void module_register(void) {
   plugin_register_read("contextswitch", cs_read);
+#if KERNEL_LINUX
+  plugin_register_shutdown("contextswitch", cs_shutdown);
+#endif
 } /* void module_register */
@@ -104,6 +104,8 @@
 #define COLLECTD_CPU_STATE_ACTIVE 11 /* sum of (!idle) */
 #define COLLECTD_CPU_STATE_MAX 12    /* #states */
 
+#define CPU_DISPATCH_BATCH 256
+
 #if HAVE_STATGRAB_H
 #include <statgrab.h>
 #endif
@@ -130,7 +132,11 @@ static mach_msg_type_number_t cpu_list_len;
 /* #endif PROCESSOR_CPU_LOAD_INFO */
 
 #elif defined(KERNEL_LINUX)
-/* no variables needed */
+#include "utils/procfs/procfs.h"
+
+#include <dirent.h>
+
+static cu_procfs_t *proc_stat;
 /* #endif KERNEL_LINUX */
 
 #elif defined(HAVE_LIBKSTAT)
@@ -202,10 +208,18 @@ static bool report_percent;
 static bool report_num_cpu;
 static bool report_guest;
 static bool subtract_guest = true;
-
-static const char *config_keys[] = {"ReportByCpu",      "ReportByState",
-                                    "ReportNumCpu",     "ValuesPercentage",
-                                    "ReportGuestState", "SubtractGuestState"};
+static bool report_by_node;
+static bool report_by_socket;
+
+/* NUMA node and socket of each CPU, or -1 if unknown. */
+static int *cpu_node;
+static int *cpu_socket;
+static size_t cpu_topology_num;
+
+static const char *config_keys[] = {
+    "ReportByCpu",      "ReportByState",      "ReportNumCpu",
+    "ValuesPercentage", "ReportGuestState",   "SubtractGuestState",
+    "ReportByNode",     "ReportBySocket"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static int cpu_config(char const *key, char const *value) /* {{{ */
@@ -222,9 +236,22 @@ static int cpu_config(char const *key, char const *value) /* {{{ */
     report_guest = IS_TRUE(value);
   else if (strcasecmp(key, "SubtractGuestState") == 0)
     subtract_guest = IS_TRUE(value);
+  else if (strcasecmp(key, "ReportByNode") == 0)
+    report_by_node = IS_TRUE(value);
+  else if (strcasecmp(key, "ReportBySocket") == 0)
+    report_by_socket = IS_TRUE(value);
   else
     return -1;
 
+#if !KERNEL_LINUX
+  if (report_by_node || report_by_socket) {
+    WARNING("cpu plugin: ReportByNode and ReportBySocket are only supported "
+            "on Linux.");
+    report_by_node = false;
+    report_by_socket = false;
+  }
+#endif
+
   return 0;
 } /* }}} int cpu_config */
 
@@ -324,36 +351,65 @@ static int init(void) {
   return 0;
 } /* int init */
 
-static void submit_value(int cpu_num, int cpu_state, const char *type,
-                         value_t value) {
-  value_list_t vl = VALUE_LIST_INIT;
+/* Collects the value lists of one read, so that machines with hundreds of
+ * CPUs don't add each value to the write queue separately. */
+typedef struct {
+  value_list_t vls[CPU_DISPATCH_BATCH];
+  value_t values[CPU_DISPATCH_BATCH];
+  size_t num;
+} cpu_batch_t;
 
-  vl.values = &value;
-  vl.values_len = 1;
+static cpu_batch_t cpu_batch;
 
-  sstrncpy(vl.plugin, "cpu", sizeof(vl.plugin));
-  sstrncpy(vl.type, type, sizeof(vl.type));
-  sstrncpy(vl.type_instance, cpu_state_names[cpu_state],
-           sizeof(vl.type_instance));
+static void cpu_batch_flush(void) {
+  if (cpu_batch.num == 0)
+    return;
+
+  plugin_dispatch_value_lists(cpu_batch.vls, cpu_batch.num);
+  cpu_batch.num = 0;
+} /* void cpu_batch_flush */
+
+/* "plugin_instance" is NULL for the global aggregation. */
+static void submit_value(char const *plugin_instance, int cpu_state,
+                         const char *type, value_t value) {
+  value_list_t *vl = cpu_batch.vls + cpu_batch.num;
+
+  cpu_batch.values[cpu_batch.num] = value;
+
+  *vl = (value_list_t)VALUE_LIST_INIT;
+  vl->values = cpu_batch.values + cpu_batch.num;
+  vl->values_len = 1;
 
-  if (cpu_num >= 0) {
-    snprintf(vl.plugin_instance, sizeof(vl.plugin_instance), "%i", cpu_num);
+  sstrncpy(vl->plugin, "cpu", sizeof(vl->plugin));
+  sstrncpy(vl->type, type, sizeof(vl->type));
+  sstrncpy(vl->type_instance, cpu_state_names[cpu_state],
+           sizeof(vl->type_instance));
+
+  if (plugin_instance != NULL) {
+    sstrncpy(vl->plugin_instance, plugin_instance,
+             sizeof(vl->plugin_instance));
   }
-  plugin_dispatch_values(&vl);
+
+  cpu_batch.num++;
+  if (cpu_batch.num == CPU_DISPATCH_BATCH)
+    cpu_batch_flush();
 }
 
-static void submit_percent(int cpu_num, int cpu_state, gauge_t value) {
+static void submit_percent(char const *plugin_instance, int cpu_state,
+                           gauge_t value) {
   /* This function is called for all known CPU states, but each read
    * method will only report a subset. The remaining states are left as
    * NAN and we ignore them here. */
   if (isnan(value))
     return;
 
-  submit_value(cpu_num, cpu_state, "percent", (value_t){.gauge = value});
+  submit_value(plugin_instance, cpu_state, "percent",
+               (value_t){.gauge = value});
 }
 
-static void submit_derive(int cpu_num, int cpu_state, derive_t value) {
-  submit_value(cpu_num, cpu_state, "cpu", (value_t){.derive = value});
+static void submit_derive(char const *plugin_instance, int cpu_state,
+                          derive_t value) {
+  submit_value(plugin_instance, cpu_state, "cpu", (value_t){.derive = value});
 }
 
 /* Takes the zero-index number of a CPU and makes sure that the module-global
@@ -465,13 +521,13 @@ static void aggregate(gauge_t *sum_by_state) /* {{{ */
 #endif /* }}} HAVE_PERFSTAT */
 } /* }}} void aggregate */
 
-/* Commits (dispatches) the values for one CPU or the global aggregation.
- * cpu_num is the index of the CPU to be committed or -1 in case of the global
- * aggregation. rates is a pointer to COLLECTD_CPU_STATE_MAX gauge_t values
+/* Commits (dispatches) the values for one CPU, group of CPUs or the global
+ * aggregation. plugin_instance identifies the CPU or group to be committed
+ * and is NULL in case of the global aggregation. rates is a pointer to COLLECTD_CPU_STATE_MAX gauge_t values
  * holding the
  * current rate; each rate may be NAN. Calculates the percentage of each state
  * and dispatches the metric. */
-static void cpu_commit_one(int cpu_num, /* {{{ */
+static void cpu_commit_one(char const *plugin_instance, /* {{{ */
                            gauge_t rates[static COLLECTD_CPU_STATE_MAX]) {
   gauge_t sum;
 
@@ -480,14 +536,12 @@ static void cpu_commit_one(int cpu_num, /* {{{ */
 
   if (!report_by_state) {
     gauge_t percent = 100.0 * rates[COLLECTD_CPU_STATE_ACTIVE] / sum;
-    submit_percent(cpu_num, COLLECTD_CPU_STATE_ACTIVE, percent);
+    submit_percent(plugin_instance, COLLECTD_CPU_STATE_ACTIVE, percent);
     return;
   }
 
-  for (size_t state = 0; state < COLLECTD_CPU_STATE_ACTIVE; state++) {
-    gauge_t percent = 100.0 * rates[state] / sum;
-    submit_percent(cpu_num, state, percent);
-  }
+  for (size_t state = 0; state < COLLECTD_CPU_STATE_ACTIVE; state++)
+    submit_percent(plugin_instance, (int)state, 100.0 * rates[state] / sum);
 } /* }}} void cpu_commit_one */
 
 /* Commits the number of cores */
@@ -517,51 +571,178 @@ static void cpu_reset(void) /* {{{ */
 /* Legacy behavior: Dispatches the raw derive values without any aggregation. */
 static void cpu_commit_without_aggregation(void) /* {{{ */
 {
-  for (int state = 0; state < COLLECTD_CPU_STATE_ACTIVE; state++) {
-    for (size_t cpu_num = 0; cpu_num < global_cpu_num; cpu_num++) {
+  for (size_t cpu_num = 0; cpu_num < global_cpu_num; cpu_num++) {
+    char plugin_instance[DATA_MAX_NAME_LEN];
+    snprintf(plugin_instance, sizeof(plugin_instance), "%zu", cpu_num);
+
+    for (int state = 0; state < COLLECTD_CPU_STATE_ACTIVE; state++) {
       cpu_state_t *s = get_cpu_state(cpu_num, state);
 
       if (!s->has_value)
         continue;
 
-      submit_derive((int)cpu_num, (int)state, s->conv.last_value.derive);
+      submit_derive(plugin_instance, (int)state, s->conv.last_value.derive);
     }
   }
 } /* }}} void cpu_commit_without_aggregation */
 
+#if KERNEL_LINUX
+/* Looks up the NUMA node and the socket (physical package) of a CPU in
+ * sysfs. Either is set to -1 if it is unknown. */
+static void cpu_topology_read(size_t cpu_num, int *ret_node, /* {{{ */
+                              int *ret_socket) {
+  char path[PATH_MAX];
+  value_t v;
+
+  snprintf(path, sizeof(path),
+           "/sys/devices/system/cpu/cpu%zu/topology/physical_package_id",
+           cpu_num);
+  if (parse_value_file(path, &v, DS_TYPE_DERIVE) == 0)
+    *ret_socket = (int)v.derive;
+
+  /* The node is given by a "node<N>" link in the CPU's directory. */
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%zu", cpu_num);
+  DIR *dh = opendir(path);
+  if (dh == NULL)
+    return;
+
+  struct dirent *de;
+  while ((de = readdir(dh)) != NULL) {
+    int node;
+    char junk;
+    if (sscanf(de->d_name, "node%d%c", &node, &junk) == 1) {
+      *ret_node = node;
+      break;
+    }
+  }
+  closedir(dh);
+} /* }}} void cpu_topology_read */
+#endif /* KERNEL_LINUX */
+
+/* Makes sure cpu_node and cpu_socket cover all CPUs of this iteration. The
+ * topology is only looked up again when the number of CPUs changes. */
+static int cpu_topology_update(void) /* {{{ */
+{
+  if (cpu_topology_num == global_cpu_num)
+    return 0;
+
+  int *node = realloc(cpu_node, global_cpu_num * sizeof(*cpu_node));
+  if (node == NULL)
+    return ENOMEM;
+  cpu_node = node;
+
+  int *socket = realloc(cpu_socket, global_cpu_num * sizeof(*cpu_socket));
+  if (socket == NULL)
+    return ENOMEM;
+  cpu_socket = socket;
+
+  for (size_t cpu_num = 0; cpu_num < global_cpu_num; cpu_num++) {
+    cpu_node[cpu_num] = -1;
+    cpu_socket[cpu_num] = -1;
+#if KERNEL_LINUX
+    cpu_topology_read(cpu_num, &cpu_node[cpu_num], &cpu_socket[cpu_num]);
+#endif
+  }
+
+  cpu_topology_num = global_cpu_num;
+  return 0;
+} /* }}} int cpu_topology_update */
+
+/* Sums the rates of the CPUs by group, i.e. by NUMA node or socket, and
+ * commits each group with the plugin instance "<prefix><group>". group_of
+ * holds the group of each CPU or -1. Requires aggregate() to have run. */
+static void cpu_commit_groups(int const *group_of, char const *prefix) /* {{{ */
+{
+  size_t groups_num = 0;
+  for (size_t cpu_num = 0; cpu_num < global_cpu_num; cpu_num++)
+    if ((group_of[cpu_num] >= 0) && ((size_t)group_of[cpu_num] >= groups_num))
+      groups_num = (size_t)group_of[cpu_num] + 1;
+
+  if (groups_num == 0)
+    return;
+
+  gauge_t *rates = calloc(groups_num * COLLECTD_CPU_STATE_MAX, sizeof(*rates));
+  if (rates == NULL) {
+    ERROR("cpu plugin: calloc failed.");
+    return;
+  }
+  for (size_t i = 0; i < groups_num * COLLECTD_CPU_STATE_MAX; i++)
+    rates[i] = NAN;
+
+  for (size_t cpu_num = 0; cpu_num < global_cpu_num; cpu_num++) {
+    if (group_of[cpu_num] < 0)
+      continue;
+
+    gauge_t *group_rates =
+        rates + (size_t)group_of[cpu_num] * COLLECTD_CPU_STATE_MAX;
+    cpu_state_t *this_cpu_states = get_cpu_state(cpu_num, 0);
+
+    for (size_t state = 0; state < COLLECTD_CPU_STATE_MAX; state++)
+      if (this_cpu_states[state].has_value)
+        RATE_ADD(group_rates[state], this_cpu_states[state].rate);
+  }
+
+  for (size_t group = 0; group < groups_num; group++) {
+    gauge_t *group_rates = rates + group * COLLECTD_CPU_STATE_MAX;
+    char plugin_instance[DATA_MAX_NAME_LEN];
+
+    /* Numbers without CPUs, e.g. memory-only NUMA nodes. */
+    if (isnan(group_rates[COLLECTD_CPU_STATE_ACTIVE]) &&
+        isnan(group_rates[COLLECTD_CPU_STATE_IDLE]))
+      continue;
+
+    snprintf(plugin_instance, sizeof(plugin_instance), "%s%zu", prefix, group);
+    cpu_commit_one(plugin_instance, group_rates);
+  }
+
+  sfree(rates);
+} /* }}} void cpu_commit_groups */
+
 /* Aggregates the internal state and dispatches the metrics. */
 static void cpu_commit(void) /* {{{ */
 {
   gauge_t global_rates[COLLECTD_CPU_STATE_MAX] = {
       NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN /* Batman! */
   };
+  bool by_group = report_by_node || report_by_socket;
+  bool without_aggregation =
+      report_by_state && report_by_cpu && !report_percent;
 
   if (report_num_cpu)
     cpu_commit_num_cpu((gauge_t)global_cpu_num);
 
-  if (report_by_state && report_by_cpu && !report_percent) {
+  if (without_aggregation)
     cpu_commit_without_aggregation();
-    return;
-  }
 
-  aggregate(global_rates);
+  if (!without_aggregation || by_group)
+    aggregate(global_rates);
 
   if (!report_by_cpu) {
-    cpu_commit_one(-1, global_rates);
-    return;
-  }
+    cpu_commit_one(NULL, global_rates);
+  } else if (!without_aggregation) {
+    for (size_t cpu_num = 0; cpu_num < global_cpu_num; cpu_num++) {
+      cpu_state_t *this_cpu_states = get_cpu_state(cpu_num, 0);
+      gauge_t local_rates[COLLECTD_CPU_STATE_MAX] = {
+          NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN};
+      char plugin_instance[DATA_MAX_NAME_LEN];
 
-  for (size_t cpu_num = 0; cpu_num < global_cpu_num; cpu_num++) {
-    cpu_state_t *this_cpu_states = get_cpu_state(cpu_num, 0);
-    gauge_t local_rates[COLLECTD_CPU_STATE_MAX] = {
-        NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN};
+      for (size_t state = 0; state < COLLECTD_CPU_STATE_MAX; state++)
+        if (this_cpu_states[state].has_value)
+          local_rates[state] = this_cpu_states[state].rate;
 
-    for (size_t state = 0; state < COLLECTD_CPU_STATE_MAX; state++)
-      if (this_cpu_states[state].has_value)
-        local_rates[state] = this_cpu_states[state].rate;
+      snprintf(plugin_instance, sizeof(plugin_instance), "%zu", cpu_num);
+      cpu_commit_one(plugin_instance, local_rates);
+    }
+  }
 
-    cpu_commit_one((int)cpu_num, local_rates);
+  if (by_group && (cpu_topology_update() == 0)) {
+    if (report_by_node)
+      cpu_commit_groups(cpu_node, "node");
+    if (report_by_socket)
+      cpu_commit_groups(cpu_socket, "socket");
   }
+
+  cpu_batch_flush();
 } /* }}} void cpu_commit */
 
 /* Adds a derive value to the internal state. This should be used by each read
@@ -637,52 +818,59 @@ static int cpu_read(void) {
   /* }}} #endif PROCESSOR_CPU_LOAD_INFO */
 
 #elif defined(KERNEL_LINUX) /* {{{ */
-  int cpu;
-  FILE *fh;
-  char buf[1024];
-
-  char *fields[11];
-  int numfields;
+  if ((proc_stat == NULL) &&
+      ((proc_stat = cu_procfs_open("/proc/stat")) == NULL)) {
+    ERROR("cpu plugin: open (/proc/stat) failed: %s", STRERRNO);
+    return -1;
+  }
 
-  if ((fh = fopen("/proc/stat", "r")) == NULL) {
-    ERROR("cpu plugin: fopen (/proc/stat) failed: %s", STRERRNO);
+  char *cursor = cu_procfs_read(proc_stat, NULL);
+  if (cursor == NULL) {
+    ERROR("cpu plugin: reading /proc/stat failed: %s", STRERRNO);
     return -1;
   }
 
-  while (fgets(buf, 1024, fh) != NULL) {
+  char *buf;
+  while ((buf = cu_procfs_line(&cursor)) != NULL) {
     if (strncmp(buf, "cpu", 3))
       continue;
     if ((buf[3] < '0') || (buf[3] > '9'))
       continue;
 
-    numfields = strsplit(buf, fields, STATIC_ARRAY_SIZE(fields));
+    uint64_t cpu_num;
+    char *ptr = cu_procfs_scan_u64(buf + 3, &cpu_num);
+    int cpu = (int)cpu_num;
+
+    /* fields[0] is unused so that the indices match the columns of the line,
+     * the first one being the name. */
+    uint64_t fields[11];
+    int numfields = 1;
+    while ((numfields < (int)STATIC_ARRAY_SIZE(fields)) &&
+           ((ptr = cu_procfs_scan_u64(ptr, &fields[numfields])) != NULL))
+      numfields++;
     if (numfields < 5)
       continue;
 
-    cpu = atoi(fields[0] + 3);
-
     /* Do not stage User and Nice immediately: we may need to alter them later:
      */
-    long long user_value = atoll(fields[1]);
-    long long nice_value = atoll(fields[2]);
-    cpu_stage(cpu, COLLECTD_CPU_STATE_SYSTEM, (derive_t)atoll(fields[3]), now);
-    cpu_stage(cpu, COLLECTD_CPU_STATE_IDLE, (derive_t)atoll(fields[4]), now);
+    long long user_value = (long long)fields[1];
+    long long nice_value = (long long)fields[2];
+    cpu_stage(cpu, COLLECTD_CPU_STATE_SYSTEM, (derive_t)fields[3], now);
+    cpu_stage(cpu, COLLECTD_CPU_STATE_IDLE, (derive_t)fields[4], now);
 
     if (numfields >= 8) {
-      cpu_stage(cpu, COLLECTD_CPU_STATE_WAIT, (derive_t)atoll(fields[5]), now);
-      cpu_stage(cpu, COLLECTD_CPU_STATE_INTERRUPT, (derive_t)atoll(fields[6]),
-                now);
-      cpu_stage(cpu, COLLECTD_CPU_STATE_SOFTIRQ, (derive_t)atoll(fields[7]),
-                now);
+      cpu_stage(cpu, COLLECTD_CPU_STATE_WAIT, (derive_t)fields[5], now);
+      cpu_stage(cpu, COLLECTD_CPU_STATE_INTERRUPT, (derive_t)fields[6], now);
+      cpu_stage(cpu, COLLECTD_CPU_STATE_SOFTIRQ, (derive_t)fields[7], now);
     }
 
     if (numfields >= 9) { /* Steal (since Linux 2.6.11) */
-      cpu_stage(cpu, COLLECTD_CPU_STATE_STEAL, (derive_t)atoll(fields[8]), now);
+      cpu_stage(cpu, COLLECTD_CPU_STATE_STEAL, (derive_t)fields[8], now);
     }
 
     if (numfields >= 10) { /* Guest (since Linux 2.6.24) */
       if (report_guest) {
-        long long value = atoll(fields[9]);
+        long long value = (long long)fields[9];
         cpu_stage(cpu, COLLECTD_CPU_STATE_GUEST, (derive_t)value, now);
         /* Guest is included in User; optionally subtract Guest from User: */
         if (subtract_guest) {
@@ -695,7 +883,7 @@ static int cpu_read(void) {
 
     if (numfields >= 11) { /* Guest_nice (since Linux 2.6.33) */
       if (report_guest) {
-        long long value = atoll(fields[10]);
+        long long value = (long long)fields[10];
         cpu_stage(cpu, COLLECTD_CPU_STATE_GUEST_NICE, (derive_t)value, now);
         /* Guest_nice is included in Nice; optionally subtract Guest_nice from
            Nice: */
@@ -711,7 +899,6 @@ static int cpu_read(void) {
     cpu_stage(cpu, COLLECTD_CPU_STATE_USER, (derive_t)user_value, now);
     cpu_stage(cpu, COLLECTD_CPU_STATE_NICE, (derive_t)nice_value, now);
   }
-  fclose(fh);
   /* }}} #endif defined(KERNEL_LINUX) */
 
 #elif defined(HAVE_LIBKSTAT) /* {{{ */
@@ -907,8 +1094,22 @@ static int cpu_read(void) {
   return 0;
 }
 
+#if KERNEL_LINUX
+static int cpu_shutdown(void) {
+  cu_procfs_close(proc_stat);
+  proc_stat = NULL;
+  sfree(cpu_node);
+  sfree(cpu_socket);
+  cpu_topology_num = 0;
+  return 0;
+}
+#endif
+
 void module_register(void) {
   plugin_register_init("cpu", init);
   plugin_register_config("cpu", cpu_config, config_keys, config_keys_num);
   plugin_register_read("cpu", cpu_read);
+#if KERNEL_LINUX
+  plugin_register_shutdown("cpu", cpu_shutdown);
+#endif
 } /* void module_register */
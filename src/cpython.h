@@ -26,35 +26,16 @@
 
 /* Some python versions don't include this by default. */
 
+#if PY_VERSION_HEX < 0x030B0000
 #include <longintrepr.h>
+#endif
 
-/* These two macros are basically Py_BEGIN_ALLOW_THREADS and
- * Py_BEGIN_ALLOW_THREADS
- * from the other direction. If a Python thread calls a C function
- * Py_BEGIN_ALLOW_THREADS is used to allow other python threads to run because
- * we don't intend to call any Python functions.
- *
- * These two macros are used whenever a C thread intends to call some Python
- * function, usually because some registered callback was triggered.
- * Just like Py_BEGIN_ALLOW_THREADS it opens a block so these macros have to be
- * used in pairs. They acquire the GIL, create a new Python thread state and
- * swap
- * the current thread state with the new one. This means this thread is now
- * allowed
- * to execute Python code. */
-
-#define CPY_LOCK_THREADS                                                       \
-  {                                                                            \
-    PyGILState_STATE gil_state;                                                \
-    gil_state = PyGILState_Ensure();
-
-#define CPY_RETURN_FROM_THREADS                                                \
-  PyGILState_Release(gil_state);                                               \
-  return
-
-#define CPY_RELEASE_THREADS                                                    \
-  PyGILState_Release(gil_state);                                               \
-  }
+/* Python 3.12 can run interpreters with their own GIL (PEP 684). Every
+ * interpreter needs its own instances of our types then, see
+ * cpy_types_current(). */
+#if PY_VERSION_HEX >= 0x030C0000
+#define CPY_SUBINTERPRETERS 1
+#endif
 
 /* This macro is a shortcut for calls like
  * x = PyObject_Repr(x);
@@ -140,6 +121,36 @@ static inline PyObject *cpy_string_to_unicode_or_bytes(const char *buf) {
 }
 
 void cpy_log_exception(const char *context);
+PyObject *cpy_dispatch_many(PyObject *self, PyObject *args, PyObject *kwds);
+
+/* With sub-interpreters the types are heap types created from the specs below
+ * when an interpreter imports the collectd module. Otherwise they are the
+ * static types. Use CPY_TYPE(Values) instead of &ValuesType. */
+#ifdef CPY_SUBINTERPRETERS
+typedef struct {
+  PyTypeObject *Config;
+  PyTypeObject *PluginData;
+  PyTypeObject *Values;
+  PyTypeObject *Notification;
+  PyTypeObject *Signed;
+  PyTypeObject *Unsigned;
+} cpy_types_t;
+
+cpy_types_t *cpy_types_current(void);
+
+#define CPY_TYPE(name) (cpy_types_current()->name)
+/* Instances of heap types own a reference to their type. */
+#define CPY_HEAP_TYPE_DECREF(type) Py_DECREF(type)
+#define CPY_HEAP_TYPE_VISIT(self) Py_VISIT(Py_TYPE(self))
+#else
+#define CPY_TYPE(name) (&name##Type)
+#define CPY_HEAP_TYPE_DECREF(type)                                             \
+  do {                                                                         \
+  } while (0)
+#define CPY_HEAP_TYPE_VISIT(self)                                              \
+  do {                                                                         \
+  } while (0)
+#endif
 
 /* Python object declarations. */
 
@@ -153,6 +164,9 @@ typedef struct {
   // clang-format on
 } Config;
 extern PyTypeObject ConfigType;
+#ifdef CPY_SUBINTERPRETERS
+extern PyType_Spec ConfigSpec;
+#endif
 
 typedef struct {
   // clang-format off
@@ -166,8 +180,11 @@ typedef struct {
   char type_instance[DATA_MAX_NAME_LEN];
 } PluginData;
 extern PyTypeObject PluginDataType;
+#ifdef CPY_SUBINTERPRETERS
+extern PyType_Spec PluginDataSpec;
+#endif
 #define PluginData_New()                                                       \
-  PyObject_CallFunctionObjArgs((PyObject *)&PluginDataType, (void *)0)
+  PyObject_CallFunctionObjArgs((PyObject *)CPY_TYPE(PluginData), (void *)0)
 
 typedef struct {
   PluginData data;
@@ -176,8 +193,11 @@ typedef struct {
   double interval;
 } Values;
 extern PyTypeObject ValuesType;
+#ifdef CPY_SUBINTERPRETERS
+extern PyType_Spec ValuesSpec;
+#endif
 #define Values_New()                                                           \
-  PyObject_CallFunctionObjArgs((PyObject *)&ValuesType, (void *)0)
+  PyObject_CallFunctionObjArgs((PyObject *)CPY_TYPE(Values), (void *)0)
 
 typedef struct {
   PluginData data;
@@ -186,11 +206,20 @@ typedef struct {
   char message[NOTIF_MAX_MSG_LEN];
 } Notification;
 extern PyTypeObject NotificationType;
+#ifdef CPY_SUBINTERPRETERS
+extern PyType_Spec NotificationSpec;
+#endif
 #define Notification_New()                                                     \
-  PyObject_CallFunctionObjArgs((PyObject *)&NotificationType, (void *)0)
+  PyObject_CallFunctionObjArgs((PyObject *)CPY_TYPE(Notification), (void *)0)
 
 typedef PyLongObject Signed;
 extern PyTypeObject SignedType;
+#ifdef CPY_SUBINTERPRETERS
+extern PyType_Spec SignedSpec;
+#endif
 
 typedef PyLongObject Unsigned;
 extern PyTypeObject UnsignedType;
+#ifdef CPY_SUBINTERPRETERS
+extern PyType_Spec UnsignedSpec;
+#endif
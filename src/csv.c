@@ -24,24 +24,65 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 #include "utils_cache.h"
 
+/* Files that have not been written to for this long are closed, so that
+ * yesterday's files do not stay open after the date suffix has changed. */
+#define CSV_IDLE_TIMEOUT TIME_T_TO_CDTIME_T_STATIC(300)
+
+/*
+ * Private data types
+ */
+typedef struct csv_file_s csv_file_t;
+struct csv_file_s {
+  char *filename;
+  char *header;
+  int fd;
+
+  char *buffer;
+  size_t buffer_fill;
+  cdtime_t first_value; /* time the oldest buffered line was added */
+  cdtime_t last_use;
+
+  /* LRU list, most recently used first. */
+  csv_file_t *prev;
+  csv_file_t *next;
+};
+
 /*
  * Private variables
  */
-static const char *config_keys[] = {"DataDir", "StoreRates"};
+static const char *config_keys[] = {"DataDir", "StoreRates", "MaxOpenFiles",
+                                    "BufferSize", "FlushTimeout"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static char *datadir;
 static int store_rates;
 static int use_stdio;
 
+static int max_open_files;
+static size_t buffer_size = 8192;
+static cdtime_t flush_timeout = TIME_T_TO_CDTIME_T_STATIC(10);
+
+static c_avl_tree_t *files;
+static int files_num;
+static csv_file_t *lru_head;
+static csv_file_t *lru_tail;
+static cdtime_t sweep_last;
+static pthread_mutex_t files_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static time_t suffix_time;
+static char suffix[12];
+static pthread_mutex_t suffix_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static int value_list_to_string(char *buffer, int buffer_len,
                                 const data_set_t *ds, const value_list_t *vl) {
   int offset;
   int status;
-  gauge_t *rates = NULL;
+  gauge_t const *rates = NULL;
+  gauge_t *rates_alloc = NULL;
 
   assert(0 == strcmp(ds->type, vl->type));
 
@@ -57,7 +98,7 @@ static int value_list_to_string(char *buffer, int buffer_len,
         (ds->ds[i].type != DS_TYPE_GAUGE) &&
         (ds->ds[i].type != DS_TYPE_DERIVE) &&
         (ds->ds[i].type != DS_TYPE_ABSOLUTE)) {
-      sfree(rates);
+      sfree(rates_alloc);
       return -1;
     }
 
@@ -66,7 +107,7 @@ static int value_list_to_string(char *buffer, int buffer_len,
                         vl->values[i].gauge);
     } else if (store_rates != 0) {
       if (rates == NULL)
-        rates = uc_get_rate(ds, vl);
+        rates = uc_get_rate_attached(ds, vl, &rates_alloc);
       if (rates == NULL) {
         WARNING("csv plugin: "
                 "uc_get_rate failed.");
@@ -85,14 +126,14 @@ static int value_list_to_string(char *buffer, int buffer_len,
     }
 
     if ((status < 1) || (status >= (buffer_len - offset))) {
-      sfree(rates);
+      sfree(rates_alloc);
       return -1;
     }
 
     offset += status;
   } /* for ds->ds_num */
 
-  sfree(rates);
+  sfree(rates_alloc);
   return 0;
 } /* int value_list_to_string */
 
@@ -130,30 +171,63 @@ static int value_list_to_filename(char *buffer, size_t buffer_size,
   ptr += strlen(ptr);
 
   /* "-2013-07-12" => 11 bytes */
-  if (ptr_size < 12) {
+  if (ptr_size < sizeof(suffix)) {
     ERROR("csv plugin: Buffer too small.");
     return ENOMEM;
   }
 
-  /* TODO: Find a way to minimize the calls to `localtime_r',
-   * since they are pretty expensive.. */
+  /* `localtime_r' is pretty expensive, so the suffix is only computed once
+   * per second. */
   now = time(NULL);
-  if (localtime_r(&now, &struct_tm) == NULL) {
-    ERROR("csv plugin: localtime_r failed");
-    return -1;
+  pthread_mutex_lock(&suffix_lock);
+  if (now != suffix_time) {
+    if (localtime_r(&now, &struct_tm) == NULL) {
+      pthread_mutex_unlock(&suffix_lock);
+      ERROR("csv plugin: localtime_r failed");
+      return -1;
+    }
+
+    status = strftime(suffix, sizeof(suffix), "-%Y-%m-%d", &struct_tm);
+    if (status == 0) /* yep, it returns zero on error. */
+    {
+      pthread_mutex_unlock(&suffix_lock);
+      ERROR("csv plugin: strftime failed");
+      return -1;
+    }
+    suffix_time = now;
   }
+  sstrncpy(ptr, suffix, ptr_size);
+  pthread_mutex_unlock(&suffix_lock);
+
+  return 0;
+} /* int value_list_to_filename */
+
+/* Formats the first line of files for "ds", including the newline. */
+static int csv_header(char *buffer, size_t buffer_size, const data_set_t *ds) {
+  size_t offset;
+  int status;
 
-  status = strftime(ptr, ptr_size, "-%Y-%m-%d", &struct_tm);
-  if (status == 0) /* yep, it returns zero on error. */
-  {
-    ERROR("csv plugin: strftime failed");
+  status = snprintf(buffer, buffer_size, "epoch");
+  if ((status < 1) || ((size_t)status >= buffer_size))
     return -1;
+  offset = (size_t)status;
+
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    status = snprintf(buffer + offset, buffer_size - offset, ",%s",
+                      ds->ds[i].name);
+    if ((status < 1) || ((size_t)status >= (buffer_size - offset)))
+      return -1;
+    offset += (size_t)status;
   }
 
+  status = snprintf(buffer + offset, buffer_size - offset, "\n");
+  if ((status < 1) || ((size_t)status >= (buffer_size - offset)))
+    return -1;
+
   return 0;
-} /* int value_list_to_filename */
+} /* int csv_header */
 
-static int csv_create_file(const char *filename, const data_set_t *ds) {
+static int csv_create_file(const char *filename, const char *header) {
   FILE *csv;
 
   if (check_create_dir(filename))
@@ -165,16 +239,290 @@ static int csv_create_file(const char *filename, const data_set_t *ds) {
     return -1;
   }
 
-  fprintf(csv, "epoch");
-  for (size_t i = 0; i < ds->ds_num; i++)
-    fprintf(csv, ",%s", ds->ds[i].name);
-
-  fprintf(csv, "\n");
+  fputs(header, csv);
   fclose(csv);
 
   return 0;
 } /* int csv_create_file */
 
+/* Makes sure "filename" is a regular file, creating it with the first line
+ * "header" if necessary. */
+static int csv_check_file(const char *filename, const char *header) {
+  struct stat statbuf;
+
+  if (stat(filename, &statbuf) == -1) {
+    if (errno == ENOENT) {
+      if (csv_create_file(filename, header))
+        return -1;
+    } else {
+      ERROR("stat(%s) failed: %s", filename, STRERRNO);
+      return -1;
+    }
+  } else if (!S_ISREG(statbuf.st_mode)) {
+    ERROR("stat(%s): Not a regular file!", filename);
+    return -1;
+  }
+
+  return 0;
+} /* int csv_check_file */
+
+/*
+ * File cache: with "MaxOpenFiles" set, files are kept open and lines are
+ * collected in a per-file buffer which is written out when it is full, when
+ * its oldest line is older than "FlushTimeout", or when the plugin is
+ * flushed. All functions below expect "files_lock" to be held.
+ */
+static void csv_lru_unlink(csv_file_t *f) {
+  if (f->prev != NULL)
+    f->prev->next = f->next;
+  else
+    lru_head = f->next;
+
+  if (f->next != NULL)
+    f->next->prev = f->prev;
+  else
+    lru_tail = f->prev;
+
+  f->prev = f->next = NULL;
+} /* void csv_lru_unlink */
+
+static void csv_lru_push(csv_file_t *f) {
+  f->prev = NULL;
+  f->next = lru_head;
+  if (lru_head != NULL)
+    lru_head->prev = f;
+  lru_head = f;
+  if (lru_tail == NULL)
+    lru_tail = f;
+} /* void csv_lru_push */
+
+/* Opens the file, creating it if necessary. */
+static int csv_file_open(csv_file_t *f) {
+  if (csv_check_file(f->filename, f->header) != 0)
+    return -1;
+
+  f->fd = open(f->filename, O_WRONLY | O_APPEND);
+  if (f->fd < 0) {
+    ERROR("csv plugin: open (%s) failed: %s", f->filename, STRERRNO);
+    return -1;
+  }
+
+  return 0;
+} /* int csv_file_open */
+
+/* Reopens the file if it has been removed or replaced since it was opened,
+ * for example by log rotation. Otherwise the lines would be appended to a file
+ * no one looks at anymore. */
+static int csv_file_check(csv_file_t *f) {
+  struct stat fd_stat;
+  struct stat path_stat;
+
+  if ((f->fd >= 0) && (fstat(f->fd, &fd_stat) == 0) &&
+      (fd_stat.st_nlink > 0) && (stat(f->filename, &path_stat) == 0) &&
+      (path_stat.st_dev == fd_stat.st_dev) &&
+      (path_stat.st_ino == fd_stat.st_ino))
+    return 0;
+
+  if (f->fd >= 0) {
+    INFO("csv plugin: %s has been moved or removed, reopening it.",
+         f->filename);
+    close(f->fd);
+    f->fd = -1;
+  }
+
+  return csv_file_open(f);
+} /* int csv_file_check */
+
+/* Writes "data" to the file while holding a write lock on it. */
+static int csv_file_append(csv_file_t *f, const char *data, size_t len) {
+  struct flock fl = {0};
+  int status;
+
+  if (csv_file_check(f) != 0)
+    return -1;
+
+  fl.l_pid = getpid();
+  fl.l_type = F_WRLCK;
+  fl.l_whence = SEEK_SET;
+
+  status = fcntl(f->fd, F_SETLK, &fl);
+  if (status != 0) {
+    ERROR("csv plugin: flock (%s) failed: %s", f->filename, STRERRNO);
+    return -1;
+  }
+
+  status = swrite(f->fd, data, len);
+  if (status != 0)
+    ERROR("csv plugin: write (%s) failed: %s", f->filename, STRERRNO);
+
+  fl.l_type = F_UNLCK;
+  fcntl(f->fd, F_SETLK, &fl);
+
+  return status;
+} /* int csv_file_append */
+
+static int csv_file_flush(csv_file_t *f) {
+  int status;
+
+  if (f->buffer_fill == 0)
+    return 0;
+
+  status = csv_file_append(f, f->buffer, f->buffer_fill);
+  if (status != 0)
+    WARNING("csv plugin: Dropping %" PRIsz " bytes for %s.", f->buffer_fill,
+            f->filename);
+  f->buffer_fill = 0;
+  return status;
+} /* int csv_file_flush */
+
+static void csv_file_close(csv_file_t *f) {
+  csv_file_flush(f);
+
+  csv_lru_unlink(f);
+  c_avl_remove(files, f->filename, NULL, NULL);
+  files_num--;
+
+  if (f->fd >= 0)
+    close(f->fd);
+  sfree(f->buffer);
+  sfree(f->header);
+  sfree(f->filename);
+  sfree(f);
+} /* void csv_file_close */
+
+static csv_file_t *csv_file_get(const char *filename, const data_set_t *ds) {
+  csv_file_t *f = NULL;
+  char header[4096];
+
+  if (c_avl_get(files, filename, (void *)&f) == 0) {
+    csv_lru_unlink(f);
+    csv_lru_push(f);
+    return f;
+  }
+
+  if (csv_header(header, sizeof(header), ds) != 0) {
+    ERROR("csv plugin: The header of %s is too long.", filename);
+    return NULL;
+  }
+
+  while ((files_num >= max_open_files) && (lru_tail != NULL))
+    csv_file_close(lru_tail);
+
+  f = calloc(1, sizeof(*f));
+  if (f == NULL)
+    return NULL;
+  f->fd = -1;
+  f->filename = strdup(filename);
+  /* Kept to recreate the file if it is removed while open. */
+  f->header = strdup(header);
+  f->buffer = malloc(buffer_size);
+  if ((f->filename == NULL) || (f->header == NULL) || (f->buffer == NULL)) {
+    ERROR("csv plugin: Out of memory.");
+    sfree(f->filename);
+    sfree(f->header);
+    sfree(f->buffer);
+    sfree(f);
+    return NULL;
+  }
+
+  if (csv_file_open(f) != 0) {
+    sfree(f->filename);
+    sfree(f->header);
+    sfree(f->buffer);
+    sfree(f);
+    return NULL;
+  }
+
+  if (c_avl_insert(files, f->filename, f) != 0) {
+    ERROR("csv plugin: c_avl_insert (%s) failed.", filename);
+    close(f->fd);
+    sfree(f->filename);
+    sfree(f->header);
+    sfree(f->buffer);
+    sfree(f);
+    return NULL;
+  }
+  files_num++;
+  csv_lru_push(f);
+
+  return f;
+} /* csv_file_t *csv_file_get */
+
+/* Writes out buffers older than "timeout" and closes idle files. The LRU list
+ * is ordered by last use, which is never before the first buffered line, so
+ * the walk can stop at the first recently used file. */
+static void csv_files_sweep(cdtime_t now, cdtime_t timeout) {
+  csv_file_t *f = lru_tail;
+
+  while (f != NULL) {
+    csv_file_t *prev = f->prev;
+
+    if ((now - f->last_use) < timeout)
+      break;
+
+    if ((now - f->last_use) >= CSV_IDLE_TIMEOUT)
+      csv_file_close(f);
+    else
+      csv_file_flush(f);
+
+    f = prev;
+  }
+} /* void csv_files_sweep */
+
+static int csv_write_cached(const char *filename, const data_set_t *ds,
+                            const char *values) {
+  size_t len = strlen(values);
+  cdtime_t now = cdtime();
+  csv_file_t *f;
+  int status = 0;
+
+  pthread_mutex_lock(&files_lock);
+
+  if (files == NULL) {
+    files = c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (files == NULL) {
+      pthread_mutex_unlock(&files_lock);
+      return -1;
+    }
+  }
+
+  f = csv_file_get(filename, ds);
+  if (f == NULL) {
+    pthread_mutex_unlock(&files_lock);
+    return -1;
+  }
+  f->last_use = now;
+
+  if (f->buffer_fill + len + 1 > buffer_size)
+    status = csv_file_flush(f);
+
+  if (len + 1 > buffer_size) {
+    /* Does not fit the buffer at all; write it directly. */
+    status = csv_file_append(f, values, len);
+    if (status == 0)
+      status = csv_file_append(f, "\n", 1);
+  } else {
+    if (f->buffer_fill == 0)
+      f->first_value = now;
+    memcpy(f->buffer + f->buffer_fill, values, len);
+    f->buffer[f->buffer_fill + len] = '\n';
+    f->buffer_fill += len + 1;
+
+    if ((now - f->first_value) >= flush_timeout)
+      status = csv_file_flush(f);
+  }
+
+  /* Buffers of files that are written to rarely are only written out here,
+   * at most once per second. */
+  if ((now - sweep_last) >= TIME_T_TO_CDTIME_T(1)) {
+    csv_files_sweep(now, flush_timeout);
+    sweep_last = now;
+  }
+
+  pthread_mutex_unlock(&files_lock);
+  return status;
+} /* int csv_write_cached */
+
 static int csv_config(const char *key, const char *value) {
   if (strcasecmp("DataDir", key) == 0) {
     if (datadir != NULL) {
@@ -205,6 +553,27 @@ static int csv_config(const char *key, const char *value) {
       store_rates = 1;
     else
       store_rates = 0;
+  } else if (strcasecmp("MaxOpenFiles", key) == 0) {
+    int tmp = atoi(value);
+    if (tmp < 0) {
+      WARNING("csv plugin: MaxOpenFiles must not be negative.");
+      return -1;
+    }
+    max_open_files = tmp;
+  } else if (strcasecmp("BufferSize", key) == 0) {
+    int tmp = atoi(value);
+    if (tmp < 1) {
+      WARNING("csv plugin: BufferSize must be positive.");
+      return -1;
+    }
+    buffer_size = (size_t)tmp;
+  } else if (strcasecmp("FlushTimeout", key) == 0) {
+    double tmp = atof(value);
+    if (tmp < 0.0) {
+      WARNING("csv plugin: FlushTimeout must not be negative.");
+      return -1;
+    }
+    flush_timeout = DOUBLE_TO_CDTIME_T(tmp);
   } else {
     return -1;
   }
@@ -213,9 +582,9 @@ static int csv_config(const char *key, const char *value) {
 
 static int csv_write(const data_set_t *ds, const value_list_t *vl,
                      user_data_t __attribute__((unused)) * user_data) {
-  struct stat statbuf;
   char filename[512];
   char values[4096];
+  char header[4096];
   FILE *csv;
   int csv_fd;
   struct flock fl = {0};
@@ -251,19 +620,15 @@ static int csv_write(const data_set_t *ds, const value_list_t *vl,
     return 0;
   }
 
-  if (stat(filename, &statbuf) == -1) {
-    if (errno == ENOENT) {
-      if (csv_create_file(filename, ds))
-        return -1;
-    } else {
-      ERROR("stat(%s) failed: %s", filename, STRERRNO);
-      return -1;
-    }
-  } else if (!S_ISREG(statbuf.st_mode)) {
-    ERROR("stat(%s): Not a regular file!", filename);
+  if (max_open_files > 0)
+    return csv_write_cached(filename, ds, values);
+
+  if (csv_header(header, sizeof(header), ds) != 0) {
+    ERROR("csv plugin: The header of %s is too long.", filename);
     return -1;
   }
-
+  if (csv_check_file(filename, header) != 0)
+    return -1;
   csv = fopen(filename, "a");
   if (csv == NULL) {
     ERROR("csv plugin: fopen (%s) failed: %s", filename, STRERRNO);
@@ -291,7 +656,33 @@ static int csv_write(const data_set_t *ds, const value_list_t *vl,
   return 0;
 } /* int csv_write */
 
+static int csv_flush(cdtime_t timeout,
+                     const char __attribute__((unused)) * identifier,
+                     user_data_t __attribute__((unused)) * user_data) {
+  pthread_mutex_lock(&files_lock);
+  for (csv_file_t *f = lru_head; f != NULL; f = f->next) {
+    if ((timeout == 0) || ((cdtime() - f->first_value) >= timeout))
+      csv_file_flush(f);
+  }
+  pthread_mutex_unlock(&files_lock);
+
+  return 0;
+} /* int csv_flush */
+
+static int csv_shutdown(void) {
+  pthread_mutex_lock(&files_lock);
+  while (lru_tail != NULL)
+    csv_file_close(lru_tail);
+  c_avl_destroy(files);
+  files = NULL;
+  pthread_mutex_unlock(&files_lock);
+
+  return 0;
+} /* int csv_shutdown */
+
 void module_register(void) {
   plugin_register_config("csv", csv_config, config_keys, config_keys_num);
   plugin_register_write("csv", csv_write, /* user_data = */ NULL);
+  plugin_register_flush("csv", csv_flush, /* user_data = */ NULL);
+  plugin_register_shutdown("csv", csv_shutdown);
 } /* void module_register */
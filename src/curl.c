@@ -25,6 +25,7 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/curl_loop/curl_loop.h"
 #include "utils/curl_stats/curl_stats.h"
 #include "utils/match/match.h"
 #include "utils_time.h"
@@ -81,6 +82,9 @@ struct web_page_s /* {{{ */
   web_match_t *matches;
 }; /* }}} */
 
+/* All pages are fetched concurrently by the loop's thread. */
+static curl_loop_t *cc_loop;
+
 /*
  * Private functions
  */
@@ -139,8 +143,10 @@ static void cc_web_page_free(void *arg) /* {{{ */
   if (wp == NULL)
     return;
 
-  if (wp->curl != NULL)
+  if (wp->curl != NULL) {
+    curl_loop_remove(cc_loop, wp->curl);
     curl_easy_cleanup(wp->curl);
+  }
   wp->curl = NULL;
 
   sfree(wp->plugin_name);
@@ -585,9 +591,22 @@ static int cc_config(oconfig_item_t *ci) /* {{{ */
 static int cc_init(void) /* {{{ */
 {
   curl_global_init(CURL_GLOBAL_SSL);
+
+  cc_loop = curl_loop_create("curl loop");
+  if (cc_loop == NULL) {
+    ERROR("curl plugin: curl_loop_create failed.");
+    return -1;
+  }
   return 0;
 } /* }}} int cc_init */
 
+static int cc_shutdown(void) /* {{{ */
+{
+  curl_loop_destroy(cc_loop);
+  cc_loop = NULL;
+  return 0;
+} /* }}} int cc_shutdown */
+
 static void cc_submit(const web_page_t *wp, const web_match_t *wm, /* {{{ */
                       value_t value) {
   value_list_t vl = VALUE_LIST_INIT;
@@ -632,42 +651,27 @@ static void cc_submit_response_time(const web_page_t *wp, /* {{{ */
   plugin_dispatch_values(&vl);
 } /* }}} void cc_submit_response_time */
 
-static int cc_read_page(user_data_t *ud) /* {{{ */
-{
-
-  if ((ud == NULL) || (ud->data == NULL)) {
-    ERROR("curl plugin: cc_read_page: Invalid user data.");
-    return -1;
-  }
-
-  web_page_t *wp = (web_page_t *)ud->data;
-
-  int status;
-  cdtime_t start = 0;
-
-  if (wp->response_time)
-    start = cdtime();
-
-  wp->buffer_fill = 0;
-
-  curl_easy_setopt(wp->curl, CURLOPT_URL, wp->url);
+static void cc_page_done(CURL *curl, CURLcode status, /* {{{ */
+                         void *user_data) {
+  web_page_t *wp = user_data;
 
-  status = curl_easy_perform(wp->curl);
   if (status != CURLE_OK) {
-    ERROR("curl plugin: curl_easy_perform failed with status %i: %s", status,
-          wp->curl_errbuf);
-    return -1;
+    ERROR("curl plugin: Fetching \"%s\" failed with status %i: %s", wp->url,
+          status, wp->curl_errbuf);
+    return;
   }
 
-  if (wp->response_time)
-    cc_submit_response_time(wp, CDTIME_T_TO_DOUBLE(cdtime() - start));
+  if (wp->response_time) {
+    double total_time = 0;
+    if (curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &total_time) == CURLE_OK)
+      cc_submit_response_time(wp, (gauge_t)total_time);
+  }
   if (wp->stats != NULL)
-    curl_stats_dispatch(wp->stats, wp->curl, NULL, "curl", wp->instance);
+    curl_stats_dispatch(wp->stats, curl, NULL, "curl", wp->instance);
 
   if (wp->response_code) {
     long response_code = 0;
-    status =
-        curl_easy_getinfo(wp->curl, CURLINFO_RESPONSE_CODE, &response_code);
+    status = curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
     if (status != CURLE_OK) {
       ERROR("curl plugin: Fetching response code failed with status %i: %s",
             status, wp->curl_errbuf);
@@ -679,8 +683,7 @@ static int cc_read_page(user_data_t *ud) /* {{{ */
   for (web_match_t *wm = wp->matches; wm != NULL; wm = wm->next) {
     cu_match_value_t *mv;
 
-    status = match_apply(wm->match, wp->buffer);
-    if (status != 0) {
+    if (match_apply(wm->match, wp->buffer) != 0) {
       WARNING("curl plugin: match_apply failed.");
       continue;
     }
@@ -694,6 +697,35 @@ static int cc_read_page(user_data_t *ud) /* {{{ */
     cc_submit(wp, wm, mv->value);
     match_value_reset(mv);
   } /* for (wm = wp->matches; wm != NULL; wm = wm->next) */
+} /* }}} void cc_page_done */
+
+static int cc_read_page(user_data_t *ud) /* {{{ */
+{
+
+  if ((ud == NULL) || (ud->data == NULL)) {
+    ERROR("curl plugin: cc_read_page: Invalid user data.");
+    return -1;
+  }
+
+  web_page_t *wp = (web_page_t *)ud->data;
+
+  /* The buffer belongs to the running transfer until it has finished. */
+  if (curl_loop_busy(cc_loop, wp->curl)) {
+    WARNING("curl plugin: The previous request for \"%s\" has not finished "
+            "yet. Skipping this interval.",
+            wp->url);
+    return 0;
+  }
+
+  wp->buffer_fill = 0;
+
+  curl_easy_setopt(wp->curl, CURLOPT_URL, wp->url);
+
+  int status = curl_loop_add(cc_loop, wp->curl, cc_page_done, wp);
+  if (status != 0) {
+    ERROR("curl plugin: curl_loop_add failed: %s", STRERROR(status));
+    return -1;
+  }
 
   return 0;
 } /* }}} int cc_read_page */
@@ -701,4 +733,5 @@ static int cc_read_page(user_data_t *ud) /* {{{ */
 void module_register(void) {
   plugin_register_complex_config("curl", cc_config);
   plugin_register_init("curl", cc_init);
+  plugin_register_shutdown("curl", cc_shutdown);
 } /* void module_register */
@@ -26,6 +26,7 @@
 #include "plugin.h"
 #include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
+#include "utils/curl_loop/curl_loop.h"
 #include "utils/curl_stats/curl_stats.h"
 #include "utils_complain.h"
 
@@ -54,6 +55,10 @@ struct cj_key_s /* {{{ */
   char *path;
   char *type;
   char *instance;
+
+  /* Data source type of "type", looked up on first use. */
+  int ds_type;
+  bool ds_type_known;
 };
 /* }}} */
 
@@ -106,8 +111,12 @@ struct cj_s /* {{{ */
 
   yajl_handle yajl;
   c_avl_tree_t *tree;
+  cj_tree_entry_t root;
   int depth;
   cj_state_t state[YAJL_MAX_DEPTH];
+  /* Nesting level within a map or array no configured key can be found in. Its
+   * contents are skipped without being looked at. */
+  int skip_depth;
 };
 typedef struct cj_s cj_t; /* }}} */
 
@@ -117,6 +126,9 @@ typedef size_t yajl_len_t;
 typedef unsigned int yajl_len_t;
 #endif
 
+/* All URLs are fetched concurrently by the loop's thread. */
+static curl_loop_t *cj_loop;
+
 static int cj_read(user_data_t *ud);
 static void cj_submit_impl(cj_t *db, cj_key_t *key, value_t *value);
 
@@ -158,6 +170,8 @@ static size_t cj_curl_callback(void *buf, /* {{{ */
 static int cj_get_type(cj_key_t *key) {
   if (key == NULL)
     return -EINVAL;
+  if (key->ds_type_known)
+    return key->ds_type;
 
   const data_set_t *ds = plugin_get_ds(key->type);
   if (ds == NULL) {
@@ -181,7 +195,9 @@ static int cj_get_type(cj_key_t *key) {
         key->type);
   }
 
-  return ds->ds[0].type;
+  key->ds_type = ds->ds[0].type;
+  key->ds_type_known = true;
+  return key->ds_type;
 }
 
 /* cj_load_key loads the configuration for "key" from the parent context and
@@ -190,10 +206,9 @@ static int cj_load_key(cj_t *db, char const *key) {
   if (db == NULL || key == NULL || db->depth <= 0)
     return EINVAL;
 
-  sstrncpy(db->state[db->depth].name, key, sizeof(db->state[db->depth].name));
-
   if (db->state[db->depth - 1].entry == NULL ||
       db->state[db->depth - 1].entry->type != TREE) {
+    db->state[db->depth].entry = NULL;
     return 0;
   }
 
@@ -206,8 +221,11 @@ static int cj_load_key(cj_t *db, char const *key) {
     db->state[db->depth].entry = e;
   } else {
     db->state[db->depth].entry = NULL;
+    return 0;
   }
 
+  /* The name is only needed to build the type instance of matched keys. */
+  sstrncpy(db->state[db->depth].name, key, sizeof(db->state[db->depth].name));
   return 0;
 }
 
@@ -227,6 +245,11 @@ static void cj_advance_array(cj_t *db) {
 #define CJ_CB_CONTINUE 1
 
 static int cj_cb_null(void *ctx) {
+  cj_t *db = (cj_t *)ctx;
+
+  if (db->skip_depth > 0)
+    return CJ_CB_CONTINUE;
+
   cj_advance_array(ctx);
   return CJ_CB_CONTINUE;
 }
@@ -234,22 +257,25 @@ static int cj_cb_null(void *ctx) {
 static int cj_cb_number(void *ctx, const char *number, yajl_len_t number_len) {
   cj_t *db = (cj_t *)ctx;
 
-  /* Create a null-terminated version of the string. */
-  char buffer[number_len + 1];
-  memcpy(buffer, number, number_len);
-  buffer[sizeof(buffer) - 1] = '\0';
+  if (db->skip_depth > 0)
+    return CJ_CB_CONTINUE;
 
   if (db->state[db->depth].entry == NULL ||
       db->state[db->depth].entry->type != KEY) {
     if (db->state[db->depth].entry != NULL) {
-      NOTICE("curl_json plugin: Found \"%s\", but the configuration expects a "
-             "map.",
-             buffer);
+      NOTICE("curl_json plugin: Found \"%.*s\", but the configuration expects "
+             "a map.",
+             (int)number_len, number);
     }
     cj_advance_array(ctx);
     return CJ_CB_CONTINUE;
   }
 
+  /* Create a null-terminated version of the string. */
+  char buffer[number_len + 1];
+  memcpy(buffer, number, number_len);
+  buffer[sizeof(buffer) - 1] = '\0';
+
   cj_key_t *key = db->state[db->depth].entry->key;
 
   int type = cj_get_type(key);
@@ -270,6 +296,11 @@ static int cj_cb_number(void *ctx, const char *number, yajl_len_t number_len) {
  * NULL. */
 static int cj_cb_map_key(void *ctx, unsigned char const *in_name,
                          yajl_len_t in_name_len) {
+  cj_t *db = (cj_t *)ctx;
+
+  if (db->skip_depth > 0)
+    return CJ_CB_CONTINUE;
+
   char name[in_name_len + 1];
 
   memmove(name, in_name, in_name_len);
@@ -295,15 +326,44 @@ static int cj_cb_boolean(void *ctx, int boolVal) {
 
 static int cj_cb_end(void *ctx) {
   cj_t *db = (cj_t *)ctx;
+
+  if (db->skip_depth > 0) {
+    db->skip_depth--;
+    /* The skipped map or array was a value of the current context. */
+    if (db->skip_depth == 0)
+      cj_advance_array(ctx);
+    return CJ_CB_CONTINUE;
+  }
+
   memset(&db->state[db->depth], 0, sizeof(db->state[db->depth]));
   db->depth--;
   cj_advance_array(ctx);
   return CJ_CB_CONTINUE;
 }
 
+/* Returns true if the map or array starting now cannot contain any configured
+ * key. Its contents are then skipped until the matching end callback. */
+static bool cj_skip_container(cj_t *db) {
+  if (db->skip_depth > 0) {
+    db->skip_depth++;
+    return true;
+  }
+
+  cj_tree_entry_t *e = db->state[db->depth].entry;
+  if ((e == NULL) || (e->type != TREE)) {
+    db->skip_depth = 1;
+    return true;
+  }
+
+  return false;
+}
+
 static int cj_cb_start_map(void *ctx) {
   cj_t *db = (cj_t *)ctx;
 
+  if (cj_skip_container(db))
+    return CJ_CB_CONTINUE;
+
   if ((db->depth + 1) >= YAJL_MAX_DEPTH) {
     ERROR("curl_json plugin: %s depth exceeds max, aborting.",
           db->url ? db->url : db->sock);
@@ -318,6 +378,9 @@ static int cj_cb_end_map(void *ctx) { return cj_cb_end(ctx); }
 static int cj_cb_start_array(void *ctx) {
   cj_t *db = (cj_t *)ctx;
 
+  if (cj_skip_container(db))
+    return CJ_CB_CONTINUE;
+
   if ((db->depth + 1) >= YAJL_MAX_DEPTH) {
     ERROR("curl_json plugin: %s depth exceeds max, aborting.",
           db->url ? db->url : db->sock);
@@ -334,7 +397,8 @@ static int cj_cb_start_array(void *ctx) {
 
 static int cj_cb_end_array(void *ctx) {
   cj_t *db = (cj_t *)ctx;
-  db->state[db->depth].in_array = false;
+  if (db->skip_depth == 0)
+    db->state[db->depth].in_array = false;
   return cj_cb_end(ctx);
 }
 
@@ -389,10 +453,16 @@ static void cj_free(void *arg) /* {{{ */
   if (db == NULL)
     return;
 
-  if (db->curl != NULL)
+  if (db->curl != NULL) {
+    curl_loop_remove(cj_loop, db->curl);
     curl_easy_cleanup(db->curl);
+  }
   db->curl = NULL;
 
+  if (db->yajl != NULL)
+    yajl_free(db->yajl);
+  db->yajl = NULL;
+
   if (db->tree != NULL)
     cj_tree_free(db->tree);
   db->tree = NULL;
@@ -877,41 +947,46 @@ static int cj_sock_perform(cj_t *db) /* {{{ */
   return 0;
 } /* }}} int cj_sock_perform */
 
-static int cj_curl_perform(cj_t *db) /* {{{ */
+static int cj_curl_result(cj_t *db, CURL *curl, CURLcode status) /* {{{ */
 {
-  int status;
   long rc;
   char *url;
 
-  curl_easy_setopt(db->curl, CURLOPT_URL, db->url);
-
-  status = curl_easy_perform(db->curl);
   if (status != CURLE_OK) {
-    ERROR("curl_json plugin: curl_easy_perform failed with status %i: %s (%s)",
+    ERROR("curl_json plugin: Fetching the URL failed with status %i: %s (%s)",
           status, db->curl_errbuf, db->url);
     return -1;
   }
   if (db->stats != NULL)
-    curl_stats_dispatch(db->stats, db->curl, cj_host(db), "curl_json",
+    curl_stats_dispatch(db->stats, curl, cj_host(db), "curl_json",
                         db->instance);
 
-  curl_easy_getinfo(db->curl, CURLINFO_EFFECTIVE_URL, &url);
-  curl_easy_getinfo(db->curl, CURLINFO_RESPONSE_CODE, &rc);
+  curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &url);
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &rc);
 
   /* The response code is zero if a non-HTTP transport was used. */
   if ((rc != 0) && (rc != 200)) {
-    ERROR("curl_json plugin: curl_easy_perform failed with "
+    ERROR("curl_json plugin: Fetching the URL failed with "
           "response code %ld (%s)",
           rc, url);
     return -1;
   }
   return 0;
-} /* }}} int cj_curl_perform */
+} /* }}} int cj_curl_result */
 
-static int cj_perform(cj_t *db) /* {{{ */
+/* Sets up the parser for a new document. */
+static int cj_parse_begin(cj_t *db) /* {{{ */
 {
-  int status;
-  yajl_handle yprev = db->yajl;
+  db->depth = 0;
+  db->skip_depth = 0;
+  memset(&db->state, 0, sizeof(db->state));
+
+  /* This is not a compound literal because EPEL6's GCC is not cool enough to
+   * handle anonymous unions within compound literals. */
+  memset(&db->root, 0, sizeof(db->root));
+  db->root.type = TREE;
+  db->root.tree = db->tree;
+  db->state[0].entry = &db->root;
 
   db->yajl = yajl_alloc(&ycallbacks,
 #if HAVE_YAJL_V2
@@ -922,41 +997,49 @@ static int cj_perform(cj_t *db) /* {{{ */
                         /* context = */ (void *)db);
   if (db->yajl == NULL) {
     ERROR("curl_json plugin: yajl_alloc failed.");
-    db->yajl = yprev;
+    db->state[0].entry = NULL;
     return -1;
   }
 
-  if (db->url)
-    status = cj_curl_perform(db);
-  else
-    status = cj_sock_perform(db);
-  if (status < 0) {
-    yajl_free(db->yajl);
-    db->yajl = yprev;
-    return -1;
-  }
+  return 0;
+} /* }}} int cj_parse_begin */
 
+/* Finishes parsing the document if all of it has been received, i. e. if
+ * "complete" is true, and releases the parser. */
+static int cj_parse_end(cj_t *db, bool complete) /* {{{ */
+{
+  int status = complete ? 0 : -1;
+
+  if (complete) {
 #if HAVE_YAJL_V2
-  status = yajl_complete_parse(db->yajl);
+    yajl_status ystatus = yajl_complete_parse(db->yajl);
 #else
-  status = yajl_parse_complete(db->yajl);
+    yajl_status ystatus = yajl_parse_complete(db->yajl);
 #endif
-  if (status != yajl_status_ok) {
-    unsigned char *errmsg;
-
-    errmsg = yajl_get_error(db->yajl, /* verbose = */ 0,
-                            /* jsonText = */ NULL, /* jsonTextLen = */ 0);
-    ERROR("curl_json plugin: yajl_parse_complete failed: %s", (char *)errmsg);
-    yajl_free_error(db->yajl, errmsg);
-    yajl_free(db->yajl);
-    db->yajl = yprev;
-    return -1;
+    if (ystatus != yajl_status_ok) {
+      unsigned char *errmsg;
+
+      errmsg = yajl_get_error(db->yajl, /* verbose = */ 0,
+                              /* jsonText = */ NULL, /* jsonTextLen = */ 0);
+      ERROR("curl_json plugin: yajl_parse_complete failed: %s",
+            (char *)errmsg);
+      yajl_free_error(db->yajl, errmsg);
+      status = -1;
+    }
   }
 
   yajl_free(db->yajl);
-  db->yajl = yprev;
-  return 0;
-} /* }}} int cj_perform */
+  db->yajl = NULL;
+  db->state[0].entry = NULL;
+  return status;
+} /* }}} int cj_parse_end */
+
+static void cj_curl_done(CURL *curl, CURLcode status, /* {{{ */
+                         void *user_data) {
+  cj_t *db = user_data;
+
+  cj_parse_end(db, cj_curl_result(db, curl, status) == 0);
+} /* }}} void cj_curl_done */
 
 static int cj_read(user_data_t *ud) /* {{{ */
 {
@@ -969,21 +1052,31 @@ static int cj_read(user_data_t *ud) /* {{{ */
 
   db = (cj_t *)ud->data;
 
-  db->depth = 0;
-  memset(&db->state, 0, sizeof(db->state));
+  /* The parser state belongs to the running transfer until it has
+   * finished. */
+  if ((db->url != NULL) && curl_loop_busy(cj_loop, db->curl)) {
+    WARNING("curl_json plugin: The previous request for \"%s\" has not "
+            "finished yet. Skipping this interval.",
+            db->url);
+    return 0;
+  }
 
-  /* This is not a compound literal because EPEL6's GCC is not cool enough to
-   * handle anonymous unions within compound literals. */
-  cj_tree_entry_t root = {0};
-  root.type = TREE;
-  root.tree = db->tree;
-  db->state[0].entry = &root;
+  if (cj_parse_begin(db) != 0)
+    return -1;
 
-  int status = cj_perform(db);
+  if (db->url == NULL)
+    return cj_parse_end(db, cj_sock_perform(db) == 0);
 
-  db->state[0].entry = NULL;
+  curl_easy_setopt(db->curl, CURLOPT_URL, db->url);
 
-  return status;
+  int status = curl_loop_add(cj_loop, db->curl, cj_curl_done, db);
+  if (status != 0) {
+    ERROR("curl_json plugin: curl_loop_add failed: %s", STRERROR(status));
+    cj_parse_end(db, false);
+    return -1;
+  }
+
+  return 0;
 } /* }}} int cj_read */
 
 static int cj_init(void) /* {{{ */
@@ -991,10 +1084,24 @@ static int cj_init(void) /* {{{ */
   /* Call this while collectd is still single-threaded to avoid
    * initialization issues in libgcrypt. */
   curl_global_init(CURL_GLOBAL_SSL);
+
+  cj_loop = curl_loop_create("curl_json loop");
+  if (cj_loop == NULL) {
+    ERROR("curl_json plugin: curl_loop_create failed.");
+    return -1;
+  }
   return 0;
 } /* }}} int cj_init */
 
+static int cj_shutdown(void) /* {{{ */
+{
+  curl_loop_destroy(cj_loop);
+  cj_loop = NULL;
+  return 0;
+} /* }}} int cj_shutdown */
+
 void module_register(void) {
   plugin_register_complex_config("curl_json", cj_config);
   plugin_register_init("curl_json", cj_init);
+  plugin_register_shutdown("curl_json", cj_shutdown);
 } /* void module_register */
@@ -126,6 +126,12 @@ DEF_TEST(parse) {
       {"{\"a\":[[10,11,12,13,14]]}", "a/0/2", 12},
       {"{\"a\":[[10,11,12,13,14]]}", "a/0/3", 13},
       {"{\"a\":[[10,11,12,13,14]]}", "a/0/4", 14},
+      /* unmatched subtrees are skipped */
+      {"{\"x\":{\"y\":[1,{\"foo\":2}]},\"foo\":5}", "foo", 5},
+      {"[{\"a\":[1,2]},[[3]],7]", "2", 7},
+      {"{\"a\":[{\"b\":[0]},{\"b\":[9]}]}", "a/1/b/0", 9},
+      {"{\"foo\":{\"bar\":1},\"baz\":2}", "baz", 2},
+      {"{\"foo\":{\"bar\":{\"x\":1}},\"foo2\":3}", "foo/bar", -1},
   };
 
   for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
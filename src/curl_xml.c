@@ -23,6 +23,7 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/curl_loop/curl_loop.h"
 #include "utils/curl_stats/curl_stats.h"
 #include "utils_llist.h"
 
@@ -102,6 +103,9 @@ struct cx_s /* {{{ */
 };
 typedef struct cx_s cx_t; /* }}} */
 
+/* All URLs are fetched concurrently by the loop's thread. */
+static curl_loop_t *cx_loop;
+
 /*
  * Private functions
  */
@@ -178,8 +182,10 @@ static void cx_free(void *arg) /* {{{ */
   if (db == NULL)
     return;
 
-  if (db->curl != NULL)
+  if (db->curl != NULL) {
+    curl_loop_remove(cx_loop, db->curl);
     curl_easy_cleanup(db->curl);
+  }
   db->curl = NULL;
 
   if (db->xpath_list != NULL)
@@ -539,46 +545,64 @@ static int cx_parse_xml(cx_t *db, char *xml) /* {{{ */
   return status;
 } /* }}} cx_parse_xml */
 
-static int cx_read(user_data_t *ud) /* {{{ */
-{
-  if ((ud == NULL) || (ud->data == NULL)) {
-    ERROR("curl_xml plugin: cx_read: Invalid user data.");
-    return -1;
-  }
-
+static void cx_curl_done(CURL *curl, CURLcode status, /* {{{ */
+                         void *user_data) {
+  cx_t *db = user_data;
   long rc;
   char *url;
-  cx_t *db = (cx_t *)ud->data;
 
-  db->buffer_fill = 0;
-
-  curl_easy_setopt(db->curl, CURLOPT_URL, db->url);
-
-  int status = curl_easy_perform(db->curl);
   if (status != CURLE_OK) {
-    ERROR("curl_xml plugin: curl_easy_perform failed with status %i: %s (%s)",
+    ERROR("curl_xml plugin: Fetching the URL failed with status %i: %s (%s)",
           status, db->curl_errbuf, db->url);
-    return -1;
+    return;
   }
   if (db->stats != NULL)
-    curl_stats_dispatch(db->stats, db->curl, cx_host(db), "curl_xml",
+    curl_stats_dispatch(db->stats, curl, cx_host(db), "curl_xml",
                         db->instance);
 
-  curl_easy_getinfo(db->curl, CURLINFO_EFFECTIVE_URL, &url);
-  curl_easy_getinfo(db->curl, CURLINFO_RESPONSE_CODE, &rc);
+  curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &url);
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &rc);
 
   /* The response code is zero if a non-HTTP transport was used. */
   if ((rc != 0) && (rc != 200)) {
-    ERROR(
-        "curl_xml plugin: curl_easy_perform failed with response code %ld (%s)",
-        rc, url);
+    ERROR("curl_xml plugin: Fetching the URL failed with response code %ld "
+          "(%s)",
+          rc, url);
+    return;
+  }
+
+  cx_parse_xml(db, db->buffer);
+  db->buffer_fill = 0;
+} /* }}} void cx_curl_done */
+
+static int cx_read(user_data_t *ud) /* {{{ */
+{
+  if ((ud == NULL) || (ud->data == NULL)) {
+    ERROR("curl_xml plugin: cx_read: Invalid user data.");
     return -1;
   }
 
-  status = cx_parse_xml(db, db->buffer);
+  cx_t *db = (cx_t *)ud->data;
+
+  /* The buffer belongs to the running transfer until it has finished. */
+  if (curl_loop_busy(cx_loop, db->curl)) {
+    WARNING("curl_xml plugin: The previous request for \"%s\" has not "
+            "finished yet. Skipping this interval.",
+            db->url);
+    return 0;
+  }
+
   db->buffer_fill = 0;
 
-  return status;
+  curl_easy_setopt(db->curl, CURLOPT_URL, db->url);
+
+  int status = curl_loop_add(cx_loop, db->curl, cx_curl_done, db);
+  if (status != 0) {
+    ERROR("curl_xml plugin: curl_loop_add failed: %s", STRERROR(status));
+    return -1;
+  }
+
+  return 0;
 } /* }}} int cx_read */
 
 /* Configuration handling functions {{{ */
@@ -966,10 +990,24 @@ static int cx_init(void) /* {{{ */
   /* Call this while collectd is still single-threaded to avoid
    * initialization issues in libgcrypt. */
   curl_global_init(CURL_GLOBAL_SSL);
+
+  cx_loop = curl_loop_create("curl_xml loop");
+  if (cx_loop == NULL) {
+    ERROR("curl_xml plugin: curl_loop_create failed.");
+    return -1;
+  }
   return 0;
 } /* }}} int cx_init */
 
+static int cx_shutdown(void) /* {{{ */
+{
+  curl_loop_destroy(cx_loop);
+  cx_loop = NULL;
+  return 0;
+} /* }}} int cx_shutdown */
+
 void module_register(void) {
   plugin_register_complex_config("curl_xml", cx_config);
   plugin_register_init("curl_xml", cx_init);
+  plugin_register_shutdown("curl_xml", cx_shutdown);
 } /* void module_register */
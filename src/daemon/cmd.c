@@ -23,6 +23,7 @@
 
 #include "cmd.h"
 #include "collectd.h"
+#include "configfile.h"
 
 #include "utils/common/common.h"
 #include <sys/un.h>
@@ -45,6 +46,10 @@ static void sig_term_handler(int __attribute__((unused)) signal) {
   stop_collectd();
 }
 
+static void sig_hup_handler(int __attribute__((unused)) signal) {
+  cf_request_reload();
+}
+
 static void sig_usr1_handler(int __attribute__((unused)) signal) {
   pthread_t thread;
   pthread_attr_t attr;
@@ -252,6 +257,14 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  struct sigaction sig_hup_action = {.sa_handler = sig_hup_handler};
+
+  if (sigaction(SIGHUP, &sig_hup_action, NULL) != 0) {
+    ERROR("Error: Failed to install a signal handler for signal HUP: %s",
+          STRERRNO);
+    return 1;
+  }
+
   struct sigaction sig_usr1_action = {.sa_handler = sig_usr1_handler};
 
   if (sigaction(SIGUSR1, &sig_usr1_action, NULL) != 0) {
@@ -260,7 +273,7 @@ int main(int argc, char **argv) {
     return 1;
   }
 
-  int exit_status = run_loop(config.test_readall);
+  int exit_status = run_loop(&config);
 
 #if COLLECT_DAEMON
   if (config.daemonize)
@@ -25,10 +25,13 @@
 #define CMD_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 struct cmdline_config {
   bool test_config;
   bool test_readall;
+  size_t bench_iterations;
+  size_t bench_threads;
   bool create_basedir;
   const char *configfile;
   bool daemonize;
@@ -36,6 +39,6 @@ struct cmdline_config {
 
 void stop_collectd(void);
 struct cmdline_config init_config(int argc, char **argv);
-int run_loop(bool test_readall);
+int run_loop(struct cmdline_config const *config);
 
 #endif /* CMD_H */
@@ -36,5 +36,5 @@ int main(int argc, char **argv) {
   }
 
   struct cmdline_config config = init_config(argc, argv);
-  return run_loop(config.test_readall);
+  return run_loop(&config);
 }
@@ -228,6 +228,9 @@ __attribute__((noreturn)) static void exit_usage(int status) {
          "                    Default: " CONFIGFILE "\n"
          "    -t              Test config and exit.\n"
          "    -T              Test plugin read and exit.\n"
+         "    -b <n>          Benchmark read and write callbacks with <n>\n"
+         "                    iterations each and exit.\n"
+         "    -j <n>          Benchmark up to <n> read callbacks at once.\n"
          "    -P <file>       PID-file.\n"
          "                    Default: " PIDFILE "\n"
 #if COLLECT_DAEMON
@@ -287,6 +290,9 @@ static int do_loop(void) {
   cdtime_t wait_until = cdtime() + interval;
 
   while (loop == 0) {
+    if (cf_reload_pending())
+      cf_reload();
+
 #if HAVE_LIBKSTAT
     update_kstat();
 #endif
@@ -311,6 +317,8 @@ static int do_loop(void) {
         ERROR("nanosleep failed: %s", STRERRNO);
         return -1;
       }
+      if (cf_reload_pending())
+        cf_reload();
     }
   } /* while (loop == 0) */
 
@@ -366,6 +374,9 @@ static void do_shot() {
     return;
   }
 
+  if (cf_reload_pending())
+    cf_reload();
+
 #if HAVE_LIBKSTAT
   update_kstat();
 #endif
@@ -388,7 +399,7 @@ static int do_shutdown(void) {
 static void read_cmdline(int argc, char **argv, struct cmdline_config *config) {
   /* read options */
   while (1) {
-    int c = getopt(argc, argv, "BhtTfC:P:");
+    int c = getopt(argc, argv, "BhtTfb:j:C:P:");
     if (c == -1)
       break;
 
@@ -409,6 +420,26 @@ static void read_cmdline(int argc, char **argv, struct cmdline_config *config) {
       config->daemonize = false;
 #endif /* COLLECT_DAEMON */
       break;
+    case 'b':
+    case 'j': {
+      char *endptr = NULL;
+      errno = 0;
+      unsigned long n = strtoul(optarg, &endptr, 0);
+      if ((errno != 0) || (endptr == optarg) || (*endptr != 0) || (n == 0)) {
+        fprintf(stderr, "Invalid argument for -%c: %s\n", c, optarg);
+        exit_usage(EXIT_FAILURE);
+      }
+      if (c == 'j') {
+        config->bench_threads = (size_t)n;
+        break;
+      }
+      config->bench_iterations = (size_t)n;
+      global_option_set("ReadThreads", "-1", 1);
+#if COLLECT_DAEMON
+      config->daemonize = false;
+#endif /* COLLECT_DAEMON */
+      break;
+    }
     case 'P':
 #if COLLECT_DAEMON
       global_option_set("PIDFile", optarg, 1);
@@ -494,7 +525,7 @@ struct cmdline_config init_config(int argc, char **argv) {
   return config;
 }
 
-int run_loop(bool test_readall) {
+int run_loop(struct cmdline_config const *config) {
   int exit_status = 0;
 
   if (do_init() != 0) {
@@ -502,7 +533,14 @@ int run_loop(bool test_readall) {
     exit_status = 1;
   }
 
-  if (test_readall) {
+  if (config->bench_iterations > 0) {
+    if (plugin_bench_all(config->bench_iterations, config->bench_threads) !=
+        0) {
+      ERROR("Error: one or more plugin callbacks failed during the "
+            "benchmark.");
+      exit_status = 1;
+    }
+  } else if (config->test_readall) {
     if (plugin_read_all_once() != 0) {
       ERROR("Error: one or more plugin read callbacks failed.");
       exit_status = 1;
@@ -34,6 +34,7 @@
 #include "plugin.h"
 #include "types_list.h"
 #include "utils/common/common.h"
+#include "write_resolution.h"
 
 #if HAVE_WORDEXP_H
 #include <wordexp.h>
@@ -64,6 +65,7 @@ typedef struct cf_callback {
 typedef struct cf_complex_callback_s {
   char *type;
   int (*callback)(oconfig_item_t *);
+  int (*reconfigure)(void);
   plugin_ctx_t ctx;
   struct cf_complex_callback_s *next;
 } cf_complex_callback_t;
@@ -102,16 +104,37 @@ static int cf_value_map_num = STATIC_ARRAY_SIZE(cf_value_map);
 
 static cf_global_option_t cf_global_options[] = {
     {"BaseDir", NULL, 0, PKGLOCALSTATEDIR},
+    {"TypesDBCache", NULL, 0, NULL},
     {"PIDFile", NULL, 0, PIDFILE},
     {"Hostname", NULL, 0, NULL},
     {"FQDNLookup", NULL, 0, "true"},
     {"Interval", NULL, 0, NULL},
     {"ReadThreads", NULL, 0, "5"},
+    {"SpreadReads", NULL, 0, "false"},
     {"WriteThreads", NULL, 0, "5"},
+    {"FilterThreads", NULL, 0, "0"},
+    {"InitThreads", NULL, 0, "1"},
     {"WriteQueueLimitHigh", NULL, 0, NULL},
     {"WriteQueueLimitLow", NULL, 0, NULL},
+    {"WriteQueuePolicy", NULL, 0, "Drop"},
+    {"WriteQueueLatencyLimit", NULL, 0, "0"},
+    {"WriteQueueType", NULL, 0, "List"},
+    {"WriteQueueSize", NULL, 0, "65536"},
+    {"WriteQueueSpool", NULL, 0, NULL},
+    {"WriteQueueSpoolSize", NULL, 0, "1024"},
+    {"WriteQueueSpoolThreshold", NULL, 0, NULL},
+    {"WriteQueueSpoolReplayRate", NULL, 0, "0"},
+    {"NotificationThreads", NULL, 0, "1"},
+    {"NotificationQueueLimit", NULL, 0, "10000"},
+    {"NotificationCoalesce", NULL, 0, "false"},
+    {"CacheHistoryLength", NULL, 0, "0"},
+    {"CacheHistoryMemoryLimit", NULL, 0, "0"},
+    {"CacheFile", NULL, 0, NULL},
+    {"CacheFileInterval", NULL, 0, "300"},
     {"Timeout", NULL, 0, "2"},
     {"AutoLoadPlugin", NULL, 0, "false"},
+    {"ReadThreadCPUs", NULL, 0, NULL},
+    {"WriteThreadCPUs", NULL, 0, NULL},
     {"CollectInternalStats", NULL, 0, "false"},
     {"PreCacheChain", NULL, 0, "PreCache"},
     {"PostCacheChain", NULL, 0, "PostCache"},
@@ -120,6 +143,12 @@ static int cf_global_options_num = STATIC_ARRAY_SIZE(cf_global_options);
 
 static int cf_default_typesdb = 1;
 
+/* The configuration read by "cf_read", kept to find what changed when the
+ * configuration is reloaded. */
+static oconfig_item_t *cf_root;
+static char *cf_root_filename;
+static volatile sig_atomic_t cf_reload_requested;
+
 /*
  * Functions to handle register/unregister, search, and other plugin related
  * stuff
@@ -287,6 +316,7 @@ static int dispatch_loadplugin(oconfig_item_t *ci) {
   plugin_ctx_t ctx = {
       .interval = cf_get_default_interval(),
       .name = strdup(name),
+      .write_limit_low = -1,
   };
   if (ctx.name == NULL)
     return ENOMEM;
@@ -302,7 +332,47 @@ static int dispatch_loadplugin(oconfig_item_t *ci) {
       cf_util_get_cdtime(child, &ctx.flush_interval);
     else if (strcasecmp("FlushTimeout", child->key) == 0)
       cf_util_get_cdtime(child, &ctx.flush_timeout);
-    else {
+    else if (strcasecmp("WriteThreads", child->key) == 0)
+      cf_util_get_int(child, &ctx.write_threads);
+    else if (strcasecmp("WriteQueueLimitHigh", child->key) == 0)
+      cf_util_get_int(child, &ctx.write_limit_high);
+    else if (strcasecmp("WriteQueueLimitLow", child->key) == 0)
+      cf_util_get_int(child, &ctx.write_limit_low);
+    else if (strcasecmp("Resolution", child->key) == 0)
+      cf_util_get_cdtime(child, &ctx.write_resolution);
+    else if (strcasecmp("ResolutionFunction", child->key) == 0) {
+      char *func = NULL;
+      if (cf_util_get_string(child, &func) != 0)
+        continue;
+      write_resolution_function_t f;
+      if (write_resolution_function_parse(func, &f) == 0)
+        ctx.write_resolution_function = (int)f;
+      else
+        WARNING("Invalid ResolutionFunction \"%s\" for plugin \"%s\". "
+                "Expected \"Average\", \"Minimum\", \"Maximum\" or "
+                "\"Last\".",
+                func, name);
+      sfree(func);
+    } else if (strcasecmp("SuppressUnchanged", child->key) == 0)
+      cf_util_get_int(child, &ctx.suppress_unchanged);
+    else if (strcasecmp("ThreadCPUs", child->key) == 0)
+      cf_util_get_string(child, &ctx.thread_cpus);
+    else if (strcasecmp("Priority", child->key) == 0)
+      cf_util_get_int(child, &ctx.priority);
+    else if (strcasecmp("WriteQueuePolicy", child->key) == 0) {
+      char *policy = NULL;
+      if (cf_util_get_string(child, &policy) != 0)
+        continue;
+      if (strcasecmp("Block", policy) == 0)
+        ctx.write_queue_block = true;
+      else if (strcasecmp("Drop", policy) == 0)
+        ctx.write_queue_block = false;
+      else
+        WARNING("Invalid WriteQueuePolicy \"%s\" for plugin \"%s\". "
+                "Expected \"Drop\" or \"Block\".",
+                policy, name);
+      sfree(policy);
+    } else {
       WARNING("Ignoring unknown LoadPlugin option \"%s\" "
               "for plugin \"%s\"",
               child->key, name);
@@ -999,6 +1069,7 @@ int cf_register_complex(const char *type, int (*callback)(oconfig_item_t *)) {
   }
 
   new->callback = callback;
+  new->reconfigure = NULL;
   new->next = NULL;
 
   new->ctx = plugin_get_ctx();
@@ -1039,7 +1110,12 @@ int cf_read(const char *filename) {
     }
   }
 
-  oconfig_free(conf);
+  oconfig_free(cf_root);
+  cf_root = conf;
+  if (filename != cf_root_filename) {
+    sfree(cf_root_filename);
+    cf_root_filename = (filename != NULL) ? strdup(filename) : NULL;
+  }
 
   /* Read the default types.db if no `TypesDB' option was given. */
   if (cf_default_typesdb) {
@@ -1051,6 +1127,347 @@ int cf_read(const char *filename) {
 
 } /* int cf_read */
 
+void cf_request_reload(void) { cf_reload_requested = 1; }
+
+bool cf_reload_pending(void) { return cf_reload_requested != 0; }
+
+int cf_register_complex_reconfigure(const char *type,
+                                    int (*callback)(void)) {
+  for (cf_complex_callback_t *cb = complex_callback_head; cb != NULL;
+       cb = cb->next) {
+    if (strcasecmp(type, cb->type) == 0) {
+      cb->reconfigure = callback;
+      return 0;
+    }
+  }
+
+  return -1;
+} /* int cf_register_complex_reconfigure */
+
+static bool cf_item_equal(oconfig_item_t const *a, /* {{{ */
+                          oconfig_item_t const *b) {
+  if ((strcasecmp(a->key, b->key) != 0) || (a->values_num != b->values_num) ||
+      (a->children_num != b->children_num))
+    return false;
+
+  for (int i = 0; i < a->values_num; i++) {
+    oconfig_value_t const *va = a->values + i;
+    oconfig_value_t const *vb = b->values + i;
+
+    if (va->type != vb->type)
+      return false;
+    if ((va->type == OCONFIG_TYPE_STRING) &&
+        (strcmp(va->value.string, vb->value.string) != 0))
+      return false;
+    if ((va->type == OCONFIG_TYPE_NUMBER) &&
+        (va->value.number != vb->value.number))
+      return false;
+    if ((va->type == OCONFIG_TYPE_BOOLEAN) &&
+        (va->value.boolean != vb->value.boolean))
+      return false;
+  }
+
+  for (int i = 0; i < a->children_num; i++)
+    if (!cf_item_equal(a->children + i, b->children + i))
+      return false;
+
+  return true;
+} /* }}} bool cf_item_equal */
+
+/* Returns the name of the plugin a "LoadPlugin" or "Plugin" item refers to. */
+static char const *cf_item_plugin(oconfig_item_t const *ci) /* {{{ */
+{
+  if ((ci->values_num < 1) || (ci->values[0].type != OCONFIG_TYPE_STRING))
+    return NULL;
+
+  if (strcmp("libvirt", ci->values[0].value.string) == 0)
+    return "virt";
+  return ci->values[0].value.string;
+} /* }}} char const *cf_item_plugin */
+
+/* Returns true if "ci" has the key "key" and, unless "plugin" is NULL, refers
+ * to the plugin "plugin". */
+static bool cf_item_matches(oconfig_item_t const *ci, /* {{{ */
+                            char const *key, char const *plugin) {
+  if (strcasecmp(key, ci->key) != 0)
+    return false;
+  if (plugin == NULL)
+    return true;
+
+  char const *name = cf_item_plugin(ci);
+  return (name != NULL) && (strcasecmp(plugin, name) == 0);
+} /* }}} bool cf_item_matches */
+
+/* Returns true if the top level items matching "key" and "plugin" are the
+ * same, in the same order, in both configurations. */
+static bool cf_items_equal(oconfig_item_t const *a, /* {{{ */
+                           oconfig_item_t const *b, char const *key,
+                           char const *plugin) {
+  int i = 0;
+  int j = 0;
+
+  while (42) {
+    while ((i < a->children_num) &&
+           !cf_item_matches(a->children + i, key, plugin))
+      i++;
+    while ((j < b->children_num) &&
+           !cf_item_matches(b->children + j, key, plugin))
+      j++;
+
+    if ((i >= a->children_num) || (j >= b->children_num))
+      return (i >= a->children_num) && (j >= b->children_num);
+    if (!cf_item_equal(a->children + i, b->children + j))
+      return false;
+    i++;
+    j++;
+  }
+} /* }}} bool cf_items_equal */
+
+/* Returns true if "conf" has a top level item matching "key" and "plugin"
+ * before the index "end". */
+static bool cf_items_contain(oconfig_item_t const *conf, /* {{{ */
+                             int end, char const *key, char const *plugin) {
+  for (int i = 0; (i < end) && (i < conf->children_num); i++)
+    if (cf_item_matches(conf->children + i, key, plugin))
+      return true;
+  return false;
+} /* }}} bool cf_items_contain */
+
+static int cf_reload_add_name(char ***names, size_t *names_num, /* {{{ */
+                              char const *name) {
+  for (size_t i = 0; i < *names_num; i++)
+    if (strcasecmp((*names)[i], name) == 0)
+      return 0;
+
+  char **tmp = realloc(*names, (*names_num + 1) * sizeof(**names));
+  if (tmp == NULL)
+    return ENOMEM;
+  *names = tmp;
+
+  tmp[*names_num] = strdup(name);
+  if (tmp[*names_num] == NULL)
+    return ENOMEM;
+  (*names_num)++;
+
+  return 0;
+} /* }}} int cf_reload_add_name */
+
+/* Applies a changed configuration of an already loaded plugin. The plugin's
+ * reconfigure callback drops its old configuration, then all of its "Plugin"
+ * blocks in "conf" are dispatched again. */
+static int cf_reload_plugin(oconfig_item_t *conf, /* {{{ */
+                            char const *name) {
+  cf_complex_callback_t *cb = complex_callback_head;
+  while ((cb != NULL) && (strcasecmp(name, cb->type) != 0))
+    cb = cb->next;
+
+  if ((cb == NULL) || (cb->reconfigure == NULL)) {
+    WARNING("configfile: The configuration of the `%s' plugin changed, but "
+            "the plugin cannot be reconfigured. Restart the daemon to apply "
+            "the change.",
+            name);
+    return 0;
+  }
+
+  plugin_ctx_t old_ctx = plugin_set_ctx(cb->ctx);
+  int status = cb->reconfigure();
+  plugin_set_ctx(old_ctx);
+  if (status != 0) {
+    ERROR("configfile: Reconfiguring the `%s' plugin failed with status %i.",
+          name, status);
+    return -1;
+  }
+
+  int ret = 0;
+  for (int i = 0; i < conf->children_num; i++) {
+    oconfig_item_t *ci = conf->children + i;
+    if ((ci->children != NULL) && cf_item_matches(ci, "Plugin", name))
+      if (dispatch_block_plugin(ci) != 0)
+        ret = -1;
+  }
+
+  INFO("configfile: Reconfigured the `%s' plugin.", name);
+  return ret;
+} /* }}} int cf_reload_plugin */
+
+/* Warns about changed global options which only take effect on restart. */
+static void cf_reload_check_globals(oconfig_item_t const *old, /* {{{ */
+                                    oconfig_item_t const *new) {
+  oconfig_item_t const *confs[] = {new, old};
+
+  for (size_t c = 0; c < STATIC_ARRAY_SIZE(confs); c++) {
+    for (int i = 0; i < confs[c]->children_num; i++) {
+      oconfig_item_t const *ci = confs[c]->children + i;
+
+      if ((ci->children != NULL) || (strcasecmp("LoadPlugin", ci->key) == 0) ||
+          (strcasecmp("PreCacheChain", ci->key) == 0) ||
+          (strcasecmp("PostCacheChain", ci->key) == 0))
+        continue;
+      /* Report each option once. */
+      if (cf_items_contain(confs[c], i, ci->key, NULL) ||
+          ((c > 0) && cf_items_contain(new, new->children_num, ci->key, NULL)))
+        continue;
+
+      if (!cf_items_equal(old, new, ci->key, NULL))
+        WARNING("configfile: The global option `%s' changed. Restart the "
+                "daemon to apply the change.",
+                ci->key);
+    }
+  }
+} /* }}} void cf_reload_check_globals */
+
+static bool cf_reload_chains_changed(oconfig_item_t const *old, /* {{{ */
+                                     oconfig_item_t const *new) {
+  return !cf_items_equal(old, new, "Chain", NULL) ||
+         !cf_items_equal(old, new, "PreCacheChain", NULL) ||
+         !cf_items_equal(old, new, "PostCacheChain", NULL);
+} /* }}} bool cf_reload_chains_changed */
+
+int cf_reload(void) /* {{{ */
+{
+  cf_reload_requested = 0;
+
+  if (cf_root == NULL) {
+    ERROR("configfile: Cannot reload the configuration: "
+          "no configuration has been read.");
+    return -1;
+  }
+
+  oconfig_item_t *conf =
+      cf_read_generic(cf_root_filename, /* pattern = */ NULL, /* depth = */ 0);
+  if ((conf == NULL) || (conf->children_num == 0)) {
+    ERROR("configfile: Reading %s failed. Keeping the current configuration.",
+          ESCAPE_NULL(cf_root_filename));
+    oconfig_free(conf);
+    return -1;
+  }
+
+  INFO("configfile: Reloading the configuration from %s.",
+       ESCAPE_NULL(cf_root_filename));
+
+  int ret = 0;
+  char **loaded = NULL;
+  size_t loaded_num = 0;
+
+  /* Load new plugins, in the order they appear in the file. */
+  for (int i = 0; i < conf->children_num; i++) {
+    oconfig_item_t *ci = conf->children + i;
+    char const *name = cf_item_plugin(ci);
+
+    if ((strcasecmp("LoadPlugin", ci->key) != 0) || (name == NULL))
+      continue;
+
+    if (!plugin_is_loaded(name)) {
+      if ((dispatch_loadplugin(ci) != 0) ||
+          (cf_reload_add_name(&loaded, &loaded_num, name) != 0))
+        ret = -1;
+    } else if (!cf_items_equal(cf_root, conf, "LoadPlugin", name) &&
+               !cf_items_contain(conf, i, "LoadPlugin", name)) {
+      WARNING("configfile: The LoadPlugin options of the `%s' plugin "
+              "changed. Restart the daemon to apply the change.",
+              name);
+    }
+  }
+
+  /* Plugins cannot be unloaded, but they stop collecting data. */
+  for (int i = 0; i < cf_root->children_num; i++) {
+    oconfig_item_t *ci = cf_root->children + i;
+    char const *name = cf_item_plugin(ci);
+
+    if ((strcasecmp("LoadPlugin", ci->key) != 0) || (name == NULL) ||
+        cf_items_contain(conf, conf->children_num, "LoadPlugin", name) ||
+        cf_items_contain(cf_root, i, "LoadPlugin", name))
+      continue;
+
+    plugin_unregister_read_plugin(name);
+    WARNING("configfile: The `%s' plugin was removed from the "
+            "configuration. Its read callbacks have been removed; restart the "
+            "daemon to unload it completely.",
+            name);
+  }
+
+  /* Configure new plugins and reconfigure changed ones. */
+  for (int i = 0; i < conf->children_num; i++) {
+    oconfig_item_t *ci = conf->children + i;
+    char const *name = cf_item_plugin(ci);
+
+    if ((ci->children == NULL) || (strcasecmp("Plugin", ci->key) != 0) ||
+        (name == NULL))
+      continue;
+
+    bool found = false;
+    for (size_t j = 0; j < loaded_num; j++)
+      if (strcasecmp(loaded[j], name) == 0)
+        found = true;
+
+    if (found || !plugin_is_loaded(name)) {
+      if (dispatch_block_plugin(ci) != 0)
+        ret = -1;
+      /* Plugins may be loaded here by "AutoLoadPlugin". */
+      if (!found && plugin_is_loaded(name) &&
+          (cf_reload_add_name(&loaded, &loaded_num, name) != 0))
+        ret = -1;
+      continue;
+    }
+
+    if (cf_items_contain(conf, i, "Plugin", name) ||
+        cf_items_equal(cf_root, conf, "Plugin", name))
+      continue;
+
+    if (cf_reload_plugin(conf, name) != 0)
+      ret = -1;
+  }
+
+  /* Plugins whose configuration was removed entirely. */
+  for (int i = 0; i < cf_root->children_num; i++) {
+    oconfig_item_t *ci = cf_root->children + i;
+    char const *name = cf_item_plugin(ci);
+
+    if ((ci->children == NULL) || (strcasecmp("Plugin", ci->key) != 0) ||
+        (name == NULL) || !plugin_is_loaded(name) ||
+        cf_items_contain(cf_root, i, "Plugin", name) ||
+        cf_items_contain(conf, conf->children_num, "Plugin", name))
+      continue;
+
+    if (cf_reload_plugin(conf, name) != 0)
+      ret = -1;
+  }
+
+  for (size_t i = 0; i < loaded_num; i++) {
+    if (plugin_init_plugin(loaded[i]) != 0)
+      ret = -1;
+    sfree(loaded[i]);
+  }
+  sfree(loaded);
+
+  if (cf_reload_chains_changed(cf_root, conf)) {
+    char const *keys[] = {"PreCacheChain", "PostCacheChain"};
+    for (size_t i = 0; i < STATIC_ARRAY_SIZE(keys); i++) {
+      if (!cf_items_contain(conf, conf->children_num, keys[i], NULL))
+        global_option_set(keys[i], NULL, /* from_cli = */ false);
+    }
+    for (int i = 0; i < conf->children_num; i++) {
+      oconfig_item_t *ci = conf->children + i;
+      if ((strcasecmp("PreCacheChain", ci->key) == 0) ||
+          (strcasecmp("PostCacheChain", ci->key) == 0))
+        dispatch_global_option(ci);
+    }
+
+    if (plugin_reconfigure_chains(conf) != 0)
+      ret = -1;
+    INFO("configfile: Rebuilt the filter chains.");
+  }
+
+  cf_reload_check_globals(cf_root, conf);
+
+  oconfig_free(cf_root);
+  cf_root = conf;
+
+  INFO("configfile: Reloading the configuration %s.",
+       (ret == 0) ? "succeeded" : "finished with errors");
+  return ret;
+} /* }}} int cf_reload */
+
 /* Assures the config option is a string, duplicates it and returns the copy in
  * "ret_string". If necessary "*ret_string" is freed first. Returns zero upon
  * success. */
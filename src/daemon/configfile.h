@@ -89,6 +89,34 @@ int cf_register_complex(const char *type, int (*callback)(oconfig_item_t *));
  */
 int cf_read(const char *filename);
 
+/*
+ * DESCRIPTION
+ *  `cf_reload' reads the config file passed to `cf_read' again and applies
+ *  the differences to the running daemon: new plugins are loaded, configured
+ *  and initialized, plugins which registered a reconfigure callback with
+ *  `cf_register_complex_reconfigure' are reconfigured if their configuration
+ *  changed, read callbacks of plugins removed from the file are unregistered
+ *  and the filter chains are rebuilt if they changed. Changes which need a
+ *  restart are logged. Must only be called from the main loop.
+ *
+ *  `cf_request_reload' only sets a flag which the main loop checks with
+ *  `cf_reload_pending'; it is safe to call from signal handlers and other
+ *  threads.
+ *
+ * RETURN VALUE
+ *  Returns zero upon success and non-zero otherwise.
+ */
+int cf_reload(void);
+void cf_request_reload(void);
+bool cf_reload_pending(void);
+
+/* Registers the callback called by `cf_reload' before the changed
+ * configuration of the plugin `type' is dispatched to the callback registered
+ * with `cf_register_complex'. It has to drop the state created by earlier
+ * configuration, including read callbacks registered from the config
+ * callback. */
+int cf_register_complex_reconfigure(const char *type, int (*callback)(void));
+
 int global_option_set(const char *option, const char *value, bool from_cli);
 const char *global_option_get(const char *option);
 long global_option_get_long(const char *option, long default_value);
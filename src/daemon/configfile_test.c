@@ -0,0 +1,233 @@
+/**
+ * collectd - src/daemon/configfile_test.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "configfile.h"
+#include "testing.h"
+#include "utils/common/common.h"
+
+static char dir[] = "/tmp/configfile_test.XXXXXX";
+static char config_file[PATH_MAX];
+static char types_file[PATH_MAX];
+
+/* Everything the "plugins" below and the plugin.c replacements are asked to
+ * do is appended to `trace'. Warnings are collected in `warnings'. */
+static char trace[1024];
+static char warnings[4096];
+
+static void trace_add(char const *format, ...) {
+  size_t len = strlen(trace);
+  if (len > 0)
+    len += snprintf(trace + len, sizeof(trace) - len, ",");
+
+  va_list ap;
+  va_start(ap, format);
+  vsnprintf(trace + len, sizeof(trace) - len, format, ap);
+  va_end(ap);
+}
+
+static void test_reset(void) {
+  trace[0] = 0;
+  warnings[0] = 0;
+}
+
+/* Passes the "Value" option of a "Plugin" block to `trace'. */
+static int test_config(oconfig_item_t *ci) {
+  char const *name = ci->values[0].value.string;
+  for (int i = 0; i < ci->children_num; i++)
+    if (strcasecmp("Value", ci->children[i].key) == 0)
+      trace_add("config:%s=%g", name, ci->children[i].values[0].value.number);
+  return 0;
+}
+
+static int test_reconfigure(void) {
+  trace_add("reset:reconf");
+  return 0;
+}
+
+/* Replacements of the plugin.c functions, overriding the weak ones in
+ * plugin_mock.c. The "reconf" plugin can be reconfigured, the others cannot.
+ */
+static char *loaded[8];
+static size_t loaded_num;
+
+bool plugin_is_loaded(char const *name) {
+  for (size_t i = 0; i < loaded_num; i++)
+    if (strcasecmp(loaded[i], name) == 0)
+      return true;
+  return false;
+}
+
+int plugin_load(char const *name, bool global) {
+  if (plugin_is_loaded(name) || (loaded_num >= STATIC_ARRAY_SIZE(loaded)))
+    return EINVAL;
+  loaded[loaded_num++] = strdup(name);
+  trace_add("load:%s", name);
+
+  cf_register_complex(name, test_config);
+  if (strcasecmp("reconf", name) == 0)
+    cf_register_complex_reconfigure(name, test_reconfigure);
+  return 0;
+}
+
+int plugin_init_plugin(char const *name) {
+  trace_add("init:%s", name);
+  return 0;
+}
+
+int plugin_unregister_read_plugin(char const *plugin) {
+  trace_add("unregister:%s", plugin);
+  return 0;
+}
+
+int plugin_reconfigure_chains(oconfig_item_t const *conf) {
+  trace_add("chains");
+  return 0;
+}
+
+int fc_configure(oconfig_item_t const *ci) { return 0; }
+
+void plugin_log(int level, char const *format, ...) {
+  char buffer[1024];
+  va_list ap;
+
+  va_start(ap, format);
+  vsnprintf(buffer, sizeof(buffer), format, ap);
+  va_end(ap);
+
+  printf("plugin_log (%i, \"%s\");\n", level, buffer);
+  if (level == LOG_WARNING) {
+    size_t len = strlen(warnings);
+    snprintf(warnings + len, sizeof(warnings) - len, "%s\n", buffer);
+  }
+}
+
+static int write_config(char const *config) {
+  FILE *fh = fopen(config_file, "w");
+  if (fh == NULL)
+    return errno;
+
+  fprintf(fh, "TypesDB \"%s\"\n%s", types_file, config);
+  return fclose(fh);
+}
+
+DEF_TEST(reload) {
+  CHECK_ZERO(write_config("Hostname \"old.example.com\"\n"
+                          "LoadPlugin reconf\n"
+                          "LoadPlugin static\n"
+                          "LoadPlugin gone\n"
+                          "<Plugin reconf>\n"
+                          "  Value 1\n"
+                          "</Plugin>\n"
+                          "<Plugin static>\n"
+                          "  Value 1\n"
+                          "</Plugin>\n"
+                          "<Chain \"test\">\n"
+                          "  Target \"stop\"\n"
+                          "</Chain>\n"));
+  CHECK_ZERO(cf_read(config_file));
+  EXPECT_EQ_STR("load:reconf,load:static,load:gone,"
+                "config:reconf=1,config:static=1",
+                trace);
+
+  /* Nothing changed. */
+  test_reset();
+  CHECK_ZERO(cf_reload());
+  EXPECT_EQ_STR("", trace);
+  EXPECT_EQ_STR("", warnings);
+
+  /* Adds "new", removes "gone", changes the blocks of "reconf" and "static",
+   * the chain and a global option. */
+  CHECK_ZERO(write_config("Hostname \"new.example.com\"\n"
+                          "LoadPlugin reconf\n"
+                          "LoadPlugin static\n"
+                          "LoadPlugin new\n"
+                          "<Plugin reconf>\n"
+                          "  Value 2\n"
+                          "</Plugin>\n"
+                          "<Plugin static>\n"
+                          "  Value 2\n"
+                          "</Plugin>\n"
+                          "<Plugin new>\n"
+                          "  Value 1\n"
+                          "</Plugin>\n"
+                          "<Chain \"test\">\n"
+                          "  Target \"return\"\n"
+                          "</Chain>\n"));
+  test_reset();
+  CHECK_ZERO(cf_reload());
+  EXPECT_EQ_STR("load:new,unregister:gone,reset:reconf,config:reconf=2,"
+                "config:new=1,init:new,chains",
+                trace);
+
+  /* "static" cannot be reconfigured and the host name is only applied on
+   * restart. Both are reported. */
+  OK(strstr(warnings, "`static' plugin changed") != NULL);
+  OK(strstr(warnings, "global option `Hostname' changed") != NULL);
+  EXPECT_EQ_STR("old.example.com", global_option_get("Hostname"));
+
+  /* A removed "Plugin" block resets the plugin without configuring it. */
+  CHECK_ZERO(write_config("Hostname \"new.example.com\"\n"
+                          "LoadPlugin reconf\n"
+                          "LoadPlugin static\n"
+                          "LoadPlugin new\n"
+                          "<Plugin static>\n"
+                          "  Value 2\n"
+                          "</Plugin>\n"
+                          "<Plugin new>\n"
+                          "  Value 1\n"
+                          "</Plugin>\n"
+                          "<Chain \"test\">\n"
+                          "  Target \"return\"\n"
+                          "</Chain>\n"));
+  test_reset();
+  CHECK_ZERO(cf_reload());
+  EXPECT_EQ_STR("reset:reconf", trace);
+  EXPECT_EQ_STR("", warnings);
+
+  return 0;
+}
+
+int main(void) {
+  if (mkdtemp(dir) == NULL) {
+    printf("mkdtemp(\"%s\") failed: %s\n", dir, STRERRNO);
+    return 1;
+  }
+  snprintf(config_file, sizeof(config_file), "%s/collectd.conf", dir);
+  snprintf(types_file, sizeof(types_file), "%s/types.db", dir);
+
+  FILE *fh = fopen(types_file, "w");
+  if (fh != NULL)
+    fclose(fh);
+
+  RUN_TEST(reload);
+
+  unlink(config_file);
+  unlink(types_file);
+  rmdir(dir);
+  for (size_t i = 0; i < loaded_num; i++)
+    sfree(loaded[i]);
+
+  END_TEST;
+}
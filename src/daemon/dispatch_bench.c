@@ -0,0 +1,524 @@
+/**
+ * collectd - src/daemon/dispatch_bench.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+/* Dispatch path benchmark. Links the real plugin.c, utils_cache.c and
+ * filter_chain.c and measures how fast value lists get from
+ * plugin_dispatch_values() to a set of no-op write callbacks. Build it with
+ * "make bench_dispatch". */
+
+#include "collectd.h"
+
+#include "configfile.h"
+#include "filter_chain.h"
+#include "plugin.h"
+#include "utils/common/common.h"
+#include "utils_time.h"
+
+#include <getopt.h>
+
+#define DEF_PRODUCERS 4
+#define DEF_WRITERS 1
+#define DEF_VALUES 1000000
+#define DEF_SERIES 1000
+#define DEF_RULES 0
+
+static long conf_producers = DEF_PRODUCERS;
+static long conf_writers = DEF_WRITERS;
+static long conf_values = DEF_VALUES;
+static long conf_series = DEF_SERIES;
+static long conf_rules = DEF_RULES;
+
+/*
+ * Allocation counting
+ *
+ * With glibc, malloc and friends are interposed so that every allocation
+ * made while the benchmark runs is counted.
+ */
+#ifdef __GLIBC__
+#define BENCH_COUNT_ALLOCS 1
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static uint64_t allocs_num;
+
+void *malloc(size_t size) {
+  __atomic_add_fetch(&allocs_num, 1, __ATOMIC_RELAXED);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+  __atomic_add_fetch(&allocs_num, 1, __ATOMIC_RELAXED);
+  return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  __atomic_add_fetch(&allocs_num, 1, __ATOMIC_RELAXED);
+  return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) { __libc_free(ptr); }
+
+static uint64_t allocs_get(void) {
+  return __atomic_load_n(&allocs_num, __ATOMIC_RELAXED);
+}
+#else
+#define BENCH_COUNT_ALLOCS 0
+static uint64_t allocs_get(void) { return 0; }
+#endif
+
+/*
+ * Writers
+ */
+static uint64_t *writer_counts;
+
+static int bench_write(data_set_t const __attribute__((unused)) * ds,
+                       value_list_t const __attribute__((unused)) * vl,
+                       user_data_t *ud) {
+  uint64_t *count = ud->data;
+  __atomic_add_fetch(count, 1, __ATOMIC_RELAXED);
+  return 0;
+}
+
+static uint64_t writers_min_count(void) {
+  uint64_t min = UINT64_MAX;
+  for (long i = 0; i < conf_writers; i++) {
+    uint64_t n = __atomic_load_n(writer_counts + i, __ATOMIC_RELAXED);
+    if (n < min)
+      min = n;
+  }
+  return min;
+}
+
+/* Counts log messages rather than printing them, so that e.g. a flood of "value
+ * too old" messages doesn't skew the results. */
+static uint64_t log_messages_num;
+
+static void bench_log(int severity, char const *msg,
+                      user_data_t __attribute__((unused)) * ud) {
+  if (severity > LOG_WARNING)
+    return;
+  if (__atomic_fetch_add(&log_messages_num, 1, __ATOMIC_RELAXED) == 0)
+    fprintf(stderr, "first log message: %s\n", msg);
+}
+
+/* The daemon only starts its write threads if there is at least one init or
+ * read callback. */
+static int bench_init(void) { return 0; }
+
+/*
+ * Filter chain
+ *
+ * The "bench" match compares the plugin name with its "Plugin" option and
+ * never matches the benchmark's value lists. It doesn't provide a
+ * constraint, so every rule in the chain is evaluated for every value.
+ */
+static int bench_match_create(oconfig_item_t const *ci, void **user_data) {
+  char *plugin = NULL;
+
+  for (int i = 0; i < ci->children_num; i++) {
+    if (strcasecmp("Plugin", ci->children[i].key) == 0)
+      cf_util_get_string(ci->children + i, &plugin);
+  }
+
+  if (plugin == NULL)
+    return -1;
+
+  *user_data = plugin;
+  return 0;
+}
+
+static int bench_match_destroy(void **user_data) {
+  sfree(*user_data);
+  return 0;
+}
+
+static int bench_match(data_set_t const __attribute__((unused)) * ds,
+                       value_list_t const *vl,
+                       notification_meta_t __attribute__((unused)) * *meta,
+                       void **user_data) {
+  if (strcmp(vl->plugin, *user_data) == 0)
+    return FC_MATCH_MATCHES;
+  return FC_MATCH_NO_MATCH;
+}
+
+static int bench_ci_init(oconfig_item_t *ci, char const *key, char const *str,
+                         int children_num) {
+  *ci = (oconfig_item_t){.key = strdup(key)};
+  if (ci->key == NULL)
+    return ENOMEM;
+
+  if (str != NULL) {
+    ci->values = calloc(1, sizeof(*ci->values));
+    if (ci->values == NULL)
+      return ENOMEM;
+    ci->values_num = 1;
+
+    ci->values[0] = (oconfig_value_t){
+        .type = OCONFIG_TYPE_STRING,
+        .value.string = strdup(str),
+    };
+    if (ci->values[0].value.string == NULL)
+      return ENOMEM;
+  }
+
+  if (children_num > 0) {
+    ci->children = calloc(children_num, sizeof(*ci->children));
+    if (ci->children == NULL)
+      return ENOMEM;
+    ci->children_num = children_num;
+  }
+
+  return 0;
+}
+
+/* Configures the chain
+ *
+ *   <Chain "bench">
+ *     <Rule>
+ *       <Match "bench">
+ *         Plugin "nomatch-<n>"
+ *       </Match>
+ *       Target "stop"
+ *     </Rule>
+ *     ...
+ *     Target "write"
+ *   </Chain>
+ *
+ * with conf_rules rules and uses it as PostCacheChain. */
+static int bench_configure_chain(void) {
+  match_proc_t mproc = {
+      .create = bench_match_create,
+      .destroy = bench_match_destroy,
+      .match = bench_match,
+  };
+  int status = fc_register_match("bench", mproc);
+  if (status != 0)
+    return status;
+
+  oconfig_item_t *chain = calloc(1, sizeof(*chain));
+  if (chain == NULL)
+    return ENOMEM;
+
+  status = bench_ci_init(chain, "Chain", "bench", (int)conf_rules + 1);
+  for (long i = 0; (status == 0) && (i < conf_rules); i++) {
+    oconfig_item_t *rule = chain->children + i;
+    char plugin[DATA_MAX_NAME_LEN];
+
+    ssnprintf(plugin, sizeof(plugin), "nomatch-%ld", i);
+    status = bench_ci_init(rule, "Rule", NULL, 2);
+    if (status == 0)
+      status = bench_ci_init(rule->children + 0, "Match", "bench", 1);
+    if (status == 0)
+      status = bench_ci_init(rule->children[0].children, "Plugin", plugin, 0);
+    if (status == 0)
+      status = bench_ci_init(rule->children + 1, "Target", "stop", 0);
+  }
+
+  if (status == 0)
+    status = bench_ci_init(chain->children + conf_rules, "Target", "write", 0);
+  if (status == 0)
+    status = fc_configure(chain);
+  if (status == 0)
+    status = global_option_set("PostCacheChain", "bench", /* from_cli = */ 0);
+
+  oconfig_free(chain);
+  return status;
+}
+
+/*
+ * Producers
+ */
+typedef struct {
+  long index;
+  uint32_t *latencies; /* in nanoseconds, one per value */
+} producer_t;
+
+static pthread_mutex_t start_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t start_cond = PTHREAD_COND_INITIALIZER;
+static bool start;
+
+static uint64_t nanotime(void) {
+  struct timespec ts = {0};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/* Producer n dispatches the series n, n + conf_producers, ... in turn. Every
+ * value gets a distinct, increasing time stamp so the cache never rejects a
+ * value as too old. */
+static void *producer_thread(void *arg) {
+  producer_t *p = arg;
+  long series_num = (conf_series - p->index + conf_producers - 1) /
+                    conf_producers;
+
+  value_t value = {.gauge = 0.0};
+  value_list_t vl = {
+      .values = &value,
+      .values_len = 1,
+      .interval = interval_g,
+  };
+  sstrncpy(vl.host, "localhost", sizeof(vl.host));
+  sstrncpy(vl.plugin, "bench", sizeof(vl.plugin));
+  ssnprintf(vl.plugin_instance, sizeof(vl.plugin_instance), "%ld", p->index);
+  sstrncpy(vl.type, "gauge", sizeof(vl.type));
+
+  pthread_mutex_lock(&start_lock);
+  while (!start)
+    pthread_cond_wait(&start_cond, &start_lock);
+  pthread_mutex_unlock(&start_lock);
+
+  cdtime_t base = cdtime();
+  for (long i = 0; i < conf_values; i++) {
+    ssnprintf(vl.type_instance, sizeof(vl.type_instance), "%ld",
+              p->index + (i % series_num) * conf_producers);
+    vl.time = base + (cdtime_t)i + 1;
+    value.gauge = (gauge_t)i;
+
+    uint64_t begin = nanotime();
+    plugin_dispatch_values(&vl);
+    uint64_t elapsed = nanotime() - begin;
+
+    p->latencies[i] = (elapsed > UINT32_MAX) ? UINT32_MAX : (uint32_t)elapsed;
+  }
+
+  return NULL;
+}
+
+static int compare_uint32(void const *a, void const *b) {
+  uint32_t x = *(uint32_t const *)a;
+  uint32_t y = *(uint32_t const *)b;
+  return (x > y) - (x < y);
+}
+
+static uint32_t percentile(uint32_t const *sorted, size_t num, double p) {
+  size_t i = (size_t)(p * (double)(num - 1) / 100.0);
+  return sorted[i];
+}
+
+/*
+ * Main
+ */
+__attribute__((noreturn)) static void exit_usage(int exit_status) {
+  fprintf((exit_status == EXIT_FAILURE) ? stderr : stdout,
+          "bench_dispatch -- collectd dispatch path benchmark\n"
+          "\n"
+          "  Usage: bench_dispatch [OPTION]\n"
+          "\n"
+          "  Valid options:\n"
+          "    -p <number>    Number of producer threads. (Default: %d)\n"
+          "    -w <number>    Number of no-op writers. (Default: %d)\n"
+          "    -n <number>    Values per producer. (Default: %d)\n"
+          "    -s <number>    Number of series. (Default: %d)\n"
+          "    -r <number>    Rules in the PostCache chain. (Default: %d)\n"
+          "    -o <opt>=<val> Set the global option <opt>, e.g.\n"
+          "                   \"WriteThreads=2\" or \"WriteQueueType=Ring\".\n"
+          "    -h             Print usage information (this output).\n",
+          DEF_PRODUCERS, DEF_WRITERS, DEF_VALUES, DEF_SERIES, DEF_RULES);
+  exit(exit_status);
+}
+
+static long get_long_opt(char const *str) {
+  char *endptr = NULL;
+
+  errno = 0;
+  long ret = strtol(str, &endptr, 0);
+  if ((errno != 0) || (endptr == str) || (*endptr != 0) || (ret < 0)) {
+    fprintf(stderr, "Not a valid number: \"%s\"\n", str);
+    exit(EXIT_FAILURE);
+  }
+
+  return ret;
+}
+
+static void read_options(int argc, char **argv) {
+  int opt;
+
+  while ((opt = getopt(argc, argv, "p:w:n:s:r:o:h")) != -1) {
+    switch (opt) {
+    case 'p':
+      conf_producers = get_long_opt(optarg);
+      break;
+    case 'w':
+      conf_writers = get_long_opt(optarg);
+      break;
+    case 'n':
+      conf_values = get_long_opt(optarg);
+      break;
+    case 's':
+      conf_series = get_long_opt(optarg);
+      break;
+    case 'r':
+      conf_rules = get_long_opt(optarg);
+      break;
+    case 'o': {
+      char *value = strchr(optarg, '=');
+      if (value == NULL)
+        exit_usage(EXIT_FAILURE);
+      *value = 0;
+      value++;
+      if (global_option_set(optarg, value, /* from_cli = */ 1) != 0) {
+        fprintf(stderr, "Unknown global option: \"%s\"\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    }
+    case 'h':
+      exit_usage(EXIT_SUCCESS);
+    default:
+      exit_usage(EXIT_FAILURE);
+    }
+  }
+
+  if ((conf_producers < 1) || (conf_writers < 1) || (conf_values < 1) ||
+      (conf_series < conf_producers)) {
+    fprintf(stderr, "Need at least one producer, writer and value, and at "
+                    "least as many series as producers.\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+int main(int argc, char **argv) {
+  plugin_init_ctx();
+  read_options(argc, argv);
+
+  hostname_set("localhost");
+  interval_g = cf_get_default_interval();
+
+  data_source_t dsrc = {"value", DS_TYPE_GAUGE, NAN, NAN};
+  data_set_t ds = {"gauge", 1, &dsrc};
+  plugin_register_data_set(&ds);
+
+  if ((conf_rules > 0) && (bench_configure_chain() != 0)) {
+    fprintf(stderr, "Configuring the filter chain failed.\n");
+    return EXIT_FAILURE;
+  }
+
+  writer_counts = calloc(conf_writers, sizeof(*writer_counts));
+  producer_t *producers = calloc(conf_producers, sizeof(*producers));
+  pthread_t *threads = calloc(conf_producers, sizeof(*threads));
+  if ((writer_counts == NULL) || (producers == NULL) || (threads == NULL))
+    return EXIT_FAILURE;
+
+  for (long i = 0; i < conf_writers; i++) {
+    char name[DATA_MAX_NAME_LEN];
+    ssnprintf(name, sizeof(name), "bench%ld", i);
+    plugin_register_write(name, bench_write,
+                          &(user_data_t){.data = writer_counts + i});
+  }
+
+  plugin_register_log("bench", bench_log, /* user_data = */ NULL);
+  plugin_register_init("bench", bench_init);
+  if (plugin_init_all() != 0) {
+    fprintf(stderr, "plugin_init_all failed.\n");
+    return EXIT_FAILURE;
+  }
+
+  for (long i = 0; i < conf_producers; i++) {
+    producers[i].index = i;
+    producers[i].latencies =
+        calloc(conf_values, sizeof(*producers[i].latencies));
+    if (producers[i].latencies == NULL)
+      return EXIT_FAILURE;
+    if (pthread_create(threads + i, NULL, producer_thread, producers + i) !=
+        0)
+      return EXIT_FAILURE;
+  }
+
+  uint64_t allocs_begin = allocs_get();
+  uint64_t time_begin = nanotime();
+
+  pthread_mutex_lock(&start_lock);
+  start = true;
+  pthread_cond_broadcast(&start_cond);
+  pthread_mutex_unlock(&start_lock);
+
+  for (long i = 0; i < conf_producers; i++)
+    pthread_join(threads[i], NULL);
+  uint64_t time_dispatched = nanotime();
+
+  /* Wait for the writers to catch up. Values can be lost, e.g. when the
+   * write queue limits drop them, so give up after a second without
+   * progress. */
+  uint64_t values_num = (uint64_t)conf_producers * (uint64_t)conf_values;
+  uint64_t written = writers_min_count();
+  uint64_t time_written = nanotime();
+  while (written < values_num) {
+    struct timespec ts = {.tv_nsec = 1000000};
+    nanosleep(&ts, NULL);
+
+    uint64_t n = writers_min_count();
+    uint64_t now = nanotime();
+    if (n != written) {
+      written = n;
+      time_written = now;
+    } else if ((now - time_written) > 1000000000) {
+      break;
+    }
+  }
+  uint64_t allocs_end = allocs_get();
+
+  size_t latencies_num = (size_t)values_num;
+  uint32_t *latencies = calloc(latencies_num, sizeof(*latencies));
+  if (latencies == NULL)
+    return EXIT_FAILURE;
+  for (long i = 0; i < conf_producers; i++) {
+    memcpy(latencies + i * conf_values, producers[i].latencies,
+           conf_values * sizeof(*latencies));
+    sfree(producers[i].latencies);
+  }
+  qsort(latencies, latencies_num, sizeof(*latencies), compare_uint32);
+
+  double dispatch_s = (double)(time_dispatched - time_begin) / 1e9;
+  double total_s = (double)(time_written - time_begin) / 1e9;
+
+  printf("producers:      %ld\n", conf_producers);
+  printf("writers:        %ld\n", conf_writers);
+  printf("series:         %ld\n", conf_series);
+  printf("chain rules:    %ld\n", conf_rules);
+  printf("values:         %" PRIu64 " dispatched, %" PRIu64 " written\n",
+         values_num, written);
+  printf("dispatch rate:  %.0f values/s\n", (double)values_num / dispatch_s);
+  printf("write rate:     %.0f values/s\n", (double)written / total_s);
+  printf("enqueue p50:    %" PRIu32 " ns\n",
+         percentile(latencies, latencies_num, 50.0));
+  printf("enqueue p99:    %" PRIu32 " ns\n",
+         percentile(latencies, latencies_num, 99.0));
+  printf("enqueue max:    %" PRIu32 " ns\n", latencies[latencies_num - 1]);
+  printf("log messages:   %" PRIu64 "\n",
+         __atomic_load_n(&log_messages_num, __ATOMIC_RELAXED));
+  if (BENCH_COUNT_ALLOCS)
+    printf("allocations:    %.2f per value\n",
+           (double)(allocs_end - allocs_begin) / (double)values_num);
+  else
+    printf("allocations:    not available\n");
+
+  plugin_shutdown_all();
+
+  sfree(latencies);
+  sfree(threads);
+  sfree(producers);
+  sfree(writer_counts);
+  return EXIT_SUCCESS;
+}
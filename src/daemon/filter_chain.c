@@ -29,6 +29,8 @@
 #include "configfile.h"
 #include "filter_chain.h"
 #include "plugin.h"
+#include "probes.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 #include "utils_complain.h"
 
@@ -43,6 +45,7 @@ struct fc_match_s {
   char name[DATA_MAX_NAME_LEN];
   match_proc_t proc;
   void *user_data;
+  bool skip; /* the rule's constraint implies that this match matches */
   fc_match_t *next;
 }; /* }}} */
 
@@ -64,15 +67,30 @@ struct fc_rule_s {
   char name[DATA_MAX_NAME_LEN];
   fc_match_t *matches;
   fc_target_t *targets;
+  fc_constraint_t constraint; /* combined constraint of all matches */
+  size_t index;               /* position in the chain */
   fc_rule_t *next;
 }; /* }}} */
 
+/* Rules of a chain, in chain order. */
+struct fc_rule_list_s;
+typedef struct fc_rule_list_s fc_rule_list_t; /* {{{ */
+struct fc_rule_list_s {
+  fc_rule_t **rules;
+  size_t rules_num;
+}; /* }}} */
+
 /* List of chains, used for `chain_list_head' */
 struct fc_chain_s /* {{{ */
 {
   char name[DATA_MAX_NAME_LEN];
   fc_rule_t *rules;
   fc_target_t *targets;
+  /* Index built by fc_chain_compile(): rules that require a specific plugin
+   * name are listed in `by_plugin' under that name, all other rules are
+   * listed in `any'. If `by_plugin' is NULL, every rule is tried. */
+  c_avl_tree_t *by_plugin;
+  fc_rule_list_t any;
   fc_chain_t *next;
 }; /* }}} */
 
@@ -81,6 +99,7 @@ struct fc_writer_s;
 typedef struct fc_writer_s fc_writer_t; /* {{{ */
 struct fc_writer_s {
   char *plugin;
+  plugin_write_handle_t *handle;
   c_complain_t complaint;
 }; /* }}} */
 
@@ -146,11 +165,31 @@ static void fc_free_rules(fc_rule_t *r) /* {{{ */
   free(r);
 } /* }}} void fc_free_rules */
 
+static void fc_free_index(fc_chain_t *c) /* {{{ */
+{
+  if (c->by_plugin != NULL) {
+    void *key;
+    fc_rule_list_t *list;
+
+    while (c_avl_pick(c->by_plugin, &key, (void *)&list) == 0) {
+      free(list->rules);
+      free(list);
+    }
+    c_avl_destroy(c->by_plugin);
+    c->by_plugin = NULL;
+  }
+
+  free(c->any.rules);
+  c->any.rules = NULL;
+  c->any.rules_num = 0;
+} /* }}} void fc_free_index */
+
 static void fc_free_chains(fc_chain_t *c) /* {{{ */
 {
   if (c == NULL)
     return;
 
+  fc_free_index(c);
   fc_free_rules(c->rules);
   fc_free_targets(c->targets);
 
@@ -178,6 +217,201 @@ static char *fc_strdup(const char *orig) /* {{{ */
   return dest;
 } /* }}} char *fc_strdup */
 
+/*
+ * Compiled chains.
+ *
+ * Matches may report a condition on the plugin and type names of the value
+ * lists they can match (see fc_constraint_t). The conditions of a rule's
+ * matches are combined into the rule's constraint, and the rules of a chain
+ * are indexed by the plugin name they require. When processing a value list,
+ * only the rules listed under its plugin name and the rules without such a
+ * requirement are tried, in chain order.
+ */
+static void fc_field_merge(char *dst, bool *dst_exact, /* {{{ */
+                           char const *src, bool src_exact) {
+  if ((src[0] == 0) || *dst_exact)
+    return;
+
+  if (src_exact || (strlen(src) > strlen(dst))) {
+    sstrncpy(dst, src, DATA_MAX_NAME_LEN);
+    *dst_exact = src_exact;
+  }
+} /* }}} void fc_field_merge */
+
+/* Returns true if every value fulfilling (dst, dst_exact) also fulfills
+ * (src, src_exact). */
+static bool fc_field_implies(char const *dst, bool dst_exact, /* {{{ */
+                             char const *src, bool src_exact) {
+  if (src[0] == 0)
+    return true;
+  if (src_exact)
+    return dst_exact && (strcmp(dst, src) == 0);
+  return strncmp(dst, src, strlen(src)) == 0;
+} /* }}} bool fc_field_implies */
+
+static bool fc_field_check(char const *value, char const *str, /* {{{ */
+                           bool exact) {
+  if (str[0] == 0)
+    return true;
+  if (exact)
+    return strcmp(value, str) == 0;
+  return strncmp(value, str, strlen(str)) == 0;
+} /* }}} bool fc_field_check */
+
+static bool fc_constraint_check(fc_constraint_t const *c, /* {{{ */
+                                value_list_t const *vl) {
+  return fc_field_check(vl->plugin, c->plugin, c->plugin_exact) &&
+         fc_field_check(vl->type, c->type, c->type_exact);
+} /* }}} bool fc_constraint_check */
+
+static int fc_match_constraint(fc_match_t *m, fc_constraint_t *c) /* {{{ */
+{
+  memset(c, 0, sizeof(*c));
+  if (m->proc.constraint == NULL)
+    return -1;
+  return (*m->proc.constraint)(c, &m->user_data);
+} /* }}} int fc_match_constraint */
+
+static void fc_rule_compile(fc_rule_t *rule) /* {{{ */
+{
+  fc_constraint_t c;
+
+  memset(&rule->constraint, 0, sizeof(rule->constraint));
+  for (fc_match_t *m = rule->matches; m != NULL; m = m->next) {
+    if (fc_match_constraint(m, &c) != 0)
+      continue;
+    fc_field_merge(rule->constraint.plugin, &rule->constraint.plugin_exact,
+                   c.plugin, c.plugin_exact);
+    fc_field_merge(rule->constraint.type, &rule->constraint.type_exact, c.type,
+                   c.type_exact);
+  }
+
+  /* Matches whose condition is sufficient and checked by the rule's
+   * constraint don't need to be called. */
+  for (fc_match_t *m = rule->matches; m != NULL; m = m->next) {
+    m->skip = (fc_match_constraint(m, &c) == 0) && c.sufficient &&
+              fc_field_implies(rule->constraint.plugin,
+                               rule->constraint.plugin_exact, c.plugin,
+                               c.plugin_exact) &&
+              fc_field_implies(rule->constraint.type,
+                               rule->constraint.type_exact, c.type,
+                               c.type_exact);
+  }
+} /* }}} void fc_rule_compile */
+
+static int fc_rule_list_append(fc_rule_list_t *list, fc_rule_t *rule) /* {{{ */
+{
+  fc_rule_t **tmp =
+      realloc(list->rules, (list->rules_num + 1) * sizeof(*list->rules));
+  if (tmp == NULL)
+    return ENOMEM;
+
+  list->rules = tmp;
+  list->rules[list->rules_num] = rule;
+  list->rules_num++;
+  return 0;
+} /* }}} int fc_rule_list_append */
+
+static int fc_chain_compile(fc_chain_t *chain) /* {{{ */
+{
+  size_t index = 0;
+  int status = 0;
+
+  fc_free_index(chain);
+
+  for (fc_rule_t *rule = chain->rules; rule != NULL; rule = rule->next) {
+    rule->index = index++;
+    fc_rule_compile(rule);
+  }
+
+  chain->by_plugin = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (chain->by_plugin == NULL)
+    return ENOMEM;
+
+  for (fc_rule_t *rule = chain->rules; rule != NULL; rule = rule->next) {
+    fc_rule_list_t *list = &chain->any;
+
+    if (rule->constraint.plugin_exact &&
+        (c_avl_get(chain->by_plugin, rule->constraint.plugin,
+                   (void *)&list) != 0)) {
+      list = calloc(1, sizeof(*list));
+      if (list == NULL) {
+        status = ENOMEM;
+        break;
+      }
+      status = c_avl_insert(chain->by_plugin, rule->constraint.plugin, list);
+      if (status != 0) {
+        free(list);
+        break;
+      }
+    }
+
+    status = fc_rule_list_append(list, rule);
+    if (status != 0)
+      break;
+  }
+
+  if (status != 0) {
+    fc_free_index(chain);
+    return status;
+  }
+
+  DEBUG("fc_chain_compile (%s): %" PRIsz " rules, %i plugin names, "
+        "%" PRIsz " rules without plugin name",
+        chain->name, index, c_avl_size(chain->by_plugin),
+        chain->any.rules_num);
+
+  return 0;
+} /* }}} int fc_chain_compile */
+
+/* Returns the rule following `prev' (the first rule if `prev' is NULL) that
+ * may match a value list whose plugin name has the list `plugin_rules'. */
+static fc_rule_t *fc_chain_next_rule(fc_chain_t const *chain, /* {{{ */
+                                     fc_rule_t *prev,
+                                     fc_rule_list_t const *plugin_rules,
+                                     size_t *any_pos, size_t *plugin_pos) {
+  if (chain->by_plugin == NULL)
+    return (prev == NULL) ? chain->rules : prev->next;
+
+  fc_rule_t *a =
+      (*any_pos < chain->any.rules_num) ? chain->any.rules[*any_pos] : NULL;
+  fc_rule_t *p = ((plugin_rules != NULL) &&
+                  (*plugin_pos < plugin_rules->rules_num))
+                     ? plugin_rules->rules[*plugin_pos]
+                     : NULL;
+
+  if ((a != NULL) && ((p == NULL) || (a->index < p->index))) {
+    (*any_pos)++;
+    return a;
+  }
+
+  if (p != NULL)
+    (*plugin_pos)++;
+  return p;
+} /* }}} fc_rule_t *fc_chain_next_rule */
+
+/* Looks up the rules of plugin name `plugin' and sets `plugin_pos' to the
+ * first of them following the rule with index `index', or to the first rule
+ * if `prev' is NULL. Used when a target has changed the plugin name. */
+static fc_rule_list_t *fc_chain_plugin_rules(fc_chain_t const *chain, /* {{{ */
+                                             char const *plugin,
+                                             fc_rule_t const *prev,
+                                             size_t *plugin_pos) {
+  fc_rule_list_t *list = NULL;
+
+  *plugin_pos = 0;
+  if ((chain->by_plugin == NULL) ||
+      (c_avl_get(chain->by_plugin, plugin, (void *)&list) != 0))
+    return NULL;
+
+  if (prev != NULL)
+    while ((*plugin_pos < list->rules_num) &&
+           (list->rules[*plugin_pos]->index <= prev->index))
+      (*plugin_pos)++;
+
+  return list;
+} /* }}} fc_rule_list_t *fc_chain_plugin_rules */
+
 /*
  * Configuration.
  *
@@ -501,6 +735,12 @@ static int fc_config_add_chain(const oconfig_item_t *ci) /* {{{ */
     return -1;
   }
 
+  status = fc_chain_compile(chain);
+  if (status != 0)
+    WARNING("Filter subsystem: Chain %s: Building the rule index failed "
+            "with status %i. All rules will be tried for every value.",
+            chain->name, status);
+
   if (chain_list_head != NULL) {
     if (!new_chain)
       return 0;
@@ -654,6 +894,11 @@ static int fc_bit_write_create(const oconfig_item_t *ci, /* {{{ */
         ERROR("fc_bit_write_create: fc_strdup failed.");
         continue;
       }
+      plugin_list[plugin_list_len].handle = plugin_write_handle(plugin);
+      if (plugin_list[plugin_list_len].handle == NULL) {
+        free(plugin_list[plugin_list_len].plugin);
+        continue;
+      }
       C_COMPLAIN_INIT(&plugin_list[plugin_list_len].complaint);
       plugin_list_len++;
       plugin_list[plugin_list_len].plugin = NULL;
@@ -725,7 +970,7 @@ static int fc_bit_write_invoke(const data_set_t *ds, /* {{{ */
     }
   } else {
     for (size_t i = 0; plugin_list[i].plugin != NULL; i++) {
-      status = plugin_write(plugin_list[i].plugin, ds, vl);
+      status = plugin_write_to(plugin_list[i].handle, ds, vl);
       if (status != 0) {
         c_complain(
             LOG_INFO, &plugin_list[i].complaint,
@@ -858,6 +1103,9 @@ fc_chain_t *fc_chain_get_by_name(const char *chain_name) /* {{{ */
 int fc_process_chain(const data_set_t *ds, value_list_t *vl, /* {{{ */
                      fc_chain_t *chain) {
   fc_target_t *target;
+  fc_rule_list_t *plugin_rules = NULL;
+  size_t any_pos = 0;
+  size_t plugin_pos = 0;
   int status = FC_TARGET_CONTINUE;
 
   if (chain == NULL)
@@ -865,10 +1113,18 @@ int fc_process_chain(const data_set_t *ds, value_list_t *vl, /* {{{ */
 
   DEBUG("fc_process_chain (chain = %s);", chain->name);
 
-  for (fc_rule_t *rule = chain->rules; rule != NULL; rule = rule->next) {
+  plugin_rules = fc_chain_plugin_rules(chain, vl->plugin, NULL, &plugin_pos);
+
+  for (fc_rule_t *rule =
+           fc_chain_next_rule(chain, NULL, plugin_rules, &any_pos, &plugin_pos);
+       rule != NULL; rule = fc_chain_next_rule(chain, rule, plugin_rules,
+                                               &any_pos, &plugin_pos)) {
     fc_match_t *match;
     status = FC_TARGET_CONTINUE;
 
+    if (!fc_constraint_check(&rule->constraint, vl))
+      continue;
+
     if (rule->name[0] != 0) {
       DEBUG("fc_process_chain (%s): Testing the `%s' rule.", chain->name,
             rule->name);
@@ -876,6 +1132,9 @@ int fc_process_chain(const data_set_t *ds, value_list_t *vl, /* {{{ */
 
     /* N. B.: rule->matches may be NULL. */
     for (match = rule->matches; match != NULL; match = match->next) {
+      if (match->skip)
+        continue;
+
       /* FIXME: Pass the meta-data to match targets here (when implemented). */
       status =
           (*match->proc.match)(ds, vl, /* meta = */ NULL, &match->user_data);
@@ -896,6 +1155,12 @@ int fc_process_chain(const data_set_t *ds, value_list_t *vl, /* {{{ */
       DEBUG("fc_process_chain (%s): Rule `%s' matches.", chain->name,
             rule->name);
     }
+    CD_PROBE4(filter_rule_match, chain->name, rule->name, vl->plugin,
+              vl->type);
+
+    /* Targets may rewrite the plugin name, which selects other rules. */
+    char plugin[DATA_MAX_NAME_LEN];
+    sstrncpy(plugin, vl->plugin, sizeof(plugin));
 
     for (target = rule->targets; target != NULL; target = target->next) {
       /* If we get here, all matches have matched the value. Execute the
@@ -919,6 +1184,10 @@ int fc_process_chain(const data_set_t *ds, value_list_t *vl, /* {{{ */
       }
     }
 
+    if (strcmp(plugin, vl->plugin) != 0)
+      plugin_rules =
+          fc_chain_plugin_rules(chain, vl->plugin, rule, &plugin_pos);
+
     if ((status == FC_TARGET_STOP) || (status == FC_TARGET_RETURN)) {
       if (rule->name[0] != 0) {
         DEBUG("fc_process_chain (%s): Rule `%s' signaled "
@@ -997,3 +1266,9 @@ int fc_configure(const oconfig_item_t *ci) /* {{{ */
 
   return -1;
 } /* }}} int fc_configure */
+
+void fc_free_all_chains(void) /* {{{ */
+{
+  fc_free_chains(chain_list_head);
+  chain_list_head = NULL;
+} /* }}} void fc_free_all_chains */
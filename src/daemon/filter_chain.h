@@ -41,11 +41,30 @@
 /*
  * Match functions
  */
+/* Condition on the identifier that a value list must fulfill for a match to
+ * possibly match it. An empty string doesn't constrain the field; otherwise
+ * the field must be equal to the string if the corresponding `*_exact' member
+ * is true, and must start with it if it is false. */
+struct fc_constraint_s {
+  char plugin[DATA_MAX_NAME_LEN];
+  bool plugin_exact;
+  char type[DATA_MAX_NAME_LEN];
+  bool type_exact;
+  /* If true, the condition is also sufficient, i.e. the match matches every
+   * value list fulfilling it. */
+  bool sufficient;
+};
+typedef struct fc_constraint_s fc_constraint_t;
+
 struct match_proc_s {
   int (*create)(const oconfig_item_t *ci, void **user_data);
   int (*destroy)(void **user_data);
   int (*match)(const data_set_t *ds, const value_list_t *vl,
                notification_meta_t **meta, void **user_data);
+  /* Optional. Fills in the condition value lists must fulfill to be matched.
+   * The filter chains use it to skip rules that cannot match a value list.
+   * Returns zero if `c' has been set. */
+  int (*constraint)(fc_constraint_t *c, void **user_data);
 };
 typedef struct match_proc_s match_proc_t;
 
@@ -100,4 +119,8 @@ int fc_default_action(const data_set_t *ds, value_list_t *vl);
  */
 int fc_configure(const oconfig_item_t *ci);
 
+/* Frees all chains created by "fc_configure", so the configuration can be
+ * reloaded. The caller has to make sure no chain is being processed. */
+void fc_free_all_chains(void);
+
 #endif /* FILTER_CHAIN_H */
@@ -0,0 +1,176 @@
+/**
+ * collectd - src/daemon/filter_chain_test.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "filter_chain.h"
+#include "testing.h"
+#include "utils/common/common.h"
+
+/* Returns the string of the "Plugin" option of a <Match> or <Target> block. */
+static char *test_plugin_option(const oconfig_item_t *ci) {
+  for (int i = 0; i < ci->children_num; i++)
+    if ((strcasecmp("Plugin", ci->children[i].key) == 0) &&
+        (ci->children[i].values_num == 1))
+      return strdup(ci->children[i].values[0].value.string);
+  return NULL;
+}
+
+static int test_create(const oconfig_item_t *ci, void **user_data) {
+  *user_data = test_plugin_option(ci);
+  return (*user_data != NULL) ? 0 : EINVAL;
+}
+
+static int test_destroy(void **user_data) {
+  sfree(*user_data);
+  return 0;
+}
+
+/* The "test_plugin" match matches value lists of one plugin and declares so
+ * with its constraint, so that its rules are indexed by plugin name. */
+static int test_match(const data_set_t *ds, const value_list_t *vl,
+                      notification_meta_t **meta, void **user_data) {
+  return (strcmp(vl->plugin, *user_data) == 0) ? FC_MATCH_MATCHES
+                                               : FC_MATCH_NO_MATCH;
+}
+
+static int test_constraint(fc_constraint_t *c, void **user_data) {
+  *c = (fc_constraint_t){.plugin_exact = true, .sufficient = true};
+  sstrncpy(c->plugin, *user_data, sizeof(c->plugin));
+  return 0;
+}
+
+/* The "test_set" target sets the plugin name. */
+static int test_set(const data_set_t *ds, value_list_t *vl,
+                    notification_meta_t **meta, void **user_data) {
+  sstrncpy(vl->plugin, *user_data, sizeof(vl->plugin));
+  return FC_TARGET_CONTINUE;
+}
+
+/* The "test_trace" target appends its "Plugin" option to `trace'. */
+static char trace[256];
+
+static int test_trace(const data_set_t *ds, value_list_t *vl,
+                      notification_meta_t **meta, void **user_data) {
+  size_t len = strlen(trace);
+  snprintf(trace + len, sizeof(trace) - len, "%s%s", (len > 0) ? "," : "",
+           (char *)*user_data);
+  return FC_TARGET_CONTINUE;
+}
+
+/* Helpers to build the configuration of a rule with a single match and
+ * target. */
+#define TEST_STRING(s)                                                         \
+  { .value.string = (s), .type = OCONFIG_TYPE_STRING }
+
+#define TEST_BLOCK(block, name, plugin_value)                                  \
+  {                                                                            \
+    .key = (block), .values = (oconfig_value_t[]){TEST_STRING(name)},          \
+    .values_num = 1,                                                           \
+    .children = (oconfig_item_t[]){{                                           \
+        .key = "Plugin",                                                       \
+        .values = (oconfig_value_t[]){TEST_STRING(plugin_value)},              \
+        .values_num = 1,                                                       \
+    }},                                                                        \
+    .children_num = 1                                                          \
+  }
+
+#define TEST_RULE(match_plugin, target, target_plugin)                         \
+  {                                                                            \
+    .key = "Rule",                                                             \
+    .children =                                                                \
+        (oconfig_item_t[]){TEST_BLOCK("Match", "test_plugin", match_plugin),   \
+                           TEST_BLOCK("Target", target, target_plugin)},       \
+    .children_num = 2                                                          \
+  }
+
+DEF_TEST(plugin_rewrite) {
+  CHECK_ZERO(fc_register_match("test_plugin",
+                               (match_proc_t){
+                                   .create = test_create,
+                                   .destroy = test_destroy,
+                                   .match = test_match,
+                                   .constraint = test_constraint,
+                               }));
+  CHECK_ZERO(fc_register_target("test_set", (target_proc_t){
+                                                .create = test_create,
+                                                .destroy = test_destroy,
+                                                .invoke = test_set,
+                                            }));
+  CHECK_ZERO(fc_register_target("test_trace", (target_proc_t){
+                                                  .create = test_create,
+                                                  .destroy = test_destroy,
+                                                  .invoke = test_trace,
+                                              }));
+
+  /* Rules of plugin "b" before and after the rule renaming "a" to "b". Only
+   * the latter must see the renamed value list. */
+  oconfig_item_t rules[] = {
+      TEST_RULE("b", "test_trace", "before"),
+      TEST_RULE("a", "test_trace", "a"),
+      TEST_RULE("a", "test_set", "b"),
+      TEST_RULE("a", "test_trace", "a-after"),
+      TEST_RULE("b", "test_trace", "after"),
+      TEST_RULE("c", "test_trace", "c"),
+  };
+  oconfig_item_t chain = {
+      .key = "Chain",
+      .values = (oconfig_value_t[]){TEST_STRING("test")},
+      .values_num = 1,
+      .children = rules,
+      .children_num = STATIC_ARRAY_SIZE(rules),
+  };
+  CHECK_ZERO(fc_configure(&chain));
+
+  fc_chain_t *c;
+  CHECK_NOT_NULL(c = fc_chain_get_by_name("test"));
+
+  value_t values[] = {{.gauge = 42}};
+  data_source_t dsrc = {"value", DS_TYPE_GAUGE, NAN, NAN};
+  data_set_t ds = {"gauge", 1, &dsrc};
+  value_list_t vl = {
+      .values = values,
+      .values_len = 1,
+      .host = "example.com",
+      .plugin = "a",
+      .type = "gauge",
+  };
+
+  EXPECT_EQ_INT(FC_TARGET_CONTINUE, fc_process_chain(&ds, &vl, c));
+  EXPECT_EQ_STR("a,after", trace);
+  EXPECT_EQ_STR("b", vl.plugin);
+
+  trace[0] = 0;
+  sstrncpy(vl.plugin, "b", sizeof(vl.plugin));
+  EXPECT_EQ_INT(FC_TARGET_CONTINUE, fc_process_chain(&ds, &vl, c));
+  EXPECT_EQ_STR("before,after", trace);
+
+  fc_free_all_chains();
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(plugin_rewrite);
+
+  END_TEST;
+}
@@ -33,14 +33,23 @@
 #include "configfile.h"
 #include "filter_chain.h"
 #include "plugin.h"
+#include "probes.h"
 #include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
+#include "utils/config_cores/config_cores.h"
 #include "utils/heap/heap.h"
+#include "utils/latency/latency.h"
+#include "utils/memstats/memstats.h"
+#include "utils/ring/ring.h"
+#include "utils/spool/spool.h"
 #include "utils_cache.h"
 #include "utils_complain.h"
+#include "utils_intern.h"
 #include "utils_llist.h"
 #include "utils_random.h"
 #include "utils_time.h"
+#include "write_resolution.h"
+#include "write_spool.h"
 
 #ifdef WIN32
 #define EXPORT __declspec(dllexport)
@@ -56,16 +65,55 @@
 
 #include <dlfcn.h>
 
+#if HAVE_PTHREAD_SETAFFINITY_NP
+#include <sched.h>
+#endif
+
+#if HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+
+#if HAVE_MALLINFO2
+#include <malloc.h>
+#endif
+
 /*
  * Private structures
  */
+/* Latency and CPU time of a read or write callback. Only allocated if
+ * "CollectInternalStats" is enabled. */
+struct callback_stats_s {
+  pthread_mutex_t lock;
+  latency_counter_t *latency; /* reset whenever the stats are reported */
+  /* Write callbacks only: time from dispatching a value list until it was
+   * handed to the callback. Reset like `latency'. */
+  latency_counter_t *age;
+  derive_t calls;
+  cdtime_t cpu_time;
+};
+typedef struct callback_stats_s callback_stats_t;
+
 struct callback_func_s {
   void *cf_callback;
   user_data_t cf_udata;
   plugin_ctx_t cf_ctx;
+  callback_stats_t *cf_stats;
 };
 typedef struct callback_func_s callback_func_t;
 
+/* Batch callback of a read group, see plugin_register_read_group(). Groups
+ * are only freed on shutdown, so read functions can point to them without
+ * holding a reference. */
+struct read_group_s {
+  char group[DATA_MAX_NAME_LEN];
+  plugin_read_group_cb callback;
+  cdtime_t window;
+  /* Schedule the members of this group are added to, so that they end up
+   * with the same read thread. */
+  struct read_sched_s *sched;
+};
+typedef struct read_group_s read_group_t;
+
 #define RF_SIMPLE 0
 #define RF_COMPLEX 1
 #define RF_REMOVE 65535
@@ -75,6 +123,7 @@ struct read_func_s {
 #define rf_callback rf_super.cf_callback
 #define rf_udata rf_super.cf_udata
 #define rf_ctx rf_super.cf_ctx
+#define rf_stats rf_super.cf_stats
   callback_func_t rf_super;
   char rf_group[DATA_MAX_NAME_LEN];
   char *rf_name;
@@ -82,6 +131,11 @@ struct read_func_s {
   cdtime_t rf_interval;
   cdtime_t rf_effective_interval;
   cdtime_t rf_next_read;
+  /* Factor the interval is stretched by while the write queue is overloaded,
+   * see "WriteQueuePolicy". */
+  unsigned int rf_stretch;
+  /* Set for complex read functions whose group has a batch callback. */
+  read_group_t *rf_read_group;
 };
 typedef struct read_func_s read_func_t;
 
@@ -93,14 +147,83 @@ struct cache_event_func_s {
 };
 typedef struct cache_event_func_s cache_event_func_t;
 
+/* Compact copy of a value list kept in the write queues. The identifier is
+ * interned, so queued copies of the same metric share its name fields, and the
+ * values, attached rates and meta data, if any, are stored in the same block.
+ */
+struct queued_value_list_s {
+  interned_identifier_t *id;
+  cdtime_t time;
+  cdtime_t interval;
+  meta_data_t *meta;
+  memstats_owner_t *owner;
+  gauge_t *rates;
+  size_t values_len;
+  bool with_meta; /* meta data copy stored in the block */
+  value_t values[];
+};
+typedef struct queued_value_list_s queued_value_list_t;
+
 struct write_queue_s;
 typedef struct write_queue_s write_queue_t;
 struct write_queue_s {
-  value_list_t *vl;
+  queued_value_list_t *qvl;
+  /* only set in the private queues of write_func_t and the filter queues */
+  const data_set_t *ds;
   plugin_ctx_t ctx;
+  /* When the value list was dispatched. Zero unless internal statistics are
+   * collected. */
+  cdtime_t dispatched;
   write_queue_t *next;
 };
 
+struct write_func_s {
+/* `write_func_t' "inherits" from `callback_func_t'.
+ * The `wf_super' member MUST be the first one in this structure! */
+#define wf_callback wf_super.cf_callback
+#define wf_udata wf_super.cf_udata
+#define wf_ctx wf_super.cf_ctx
+#define wf_stats wf_super.cf_stats
+  callback_func_t wf_super;
+
+  /* Private queue, used only if `wf_threads_num' is non-zero and the
+   * threads are running. Otherwise the callback is called directly by the
+   * global write threads. */
+  write_queue_t *wf_queue_head;
+  write_queue_t *wf_queue_tail;
+  long wf_queue_length;
+  long wf_limit_high;
+  long wf_limit_low;
+  bool wf_block;
+  derive_t wf_dropped;
+  cdtime_t wf_last_drop_message;
+
+  bool wf_loop;
+  pthread_mutex_t wf_lock;
+  pthread_cond_t wf_cond;      /* signalled when the queue is not empty */
+  pthread_cond_t wf_cond_free; /* signalled when the queue is not full */
+  pthread_t *wf_threads;
+  size_t wf_threads_num;
+
+  /* Non-zero for writers registered with plugin_register_write_batch(). In
+   * that case `wf_callback' is a `plugin_write_batch_cb'. */
+  size_t wf_batch_size;
+  cdtime_t wf_batch_max_age;
+
+  /* Consolidates the values before they are handed to the writer, if the
+   * plugin has a "Resolution". */
+  write_resolution_t *wf_resolution;
+};
+typedef struct write_func_s write_func_t;
+
+/* Write callback looked up by name once, see plugin_write_handle(). */
+struct plugin_write_handle_s {
+  char *name;
+  /* NULL while no write callback of that name is registered. */
+  write_func_t *wf;
+  plugin_write_handle_t *next;
+};
+
 struct flush_callback_s {
   char *name;
   cdtime_t timeout;
@@ -120,51 +243,223 @@ static llist_t *list_shutdown;
 static llist_t *list_log;
 static llist_t *list_notification;
 
+/* Serializes changes of the callback lists above, so that init callbacks
+ * registered with plugin_register_init_concurrent() may register callbacks
+ * while running concurrently. */
+static pthread_mutex_t register_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Protected by `register_lock'. Handles are never freed. */
+static plugin_write_handle_t *write_handles;
+
+/* User data of init callbacks registered with
+ * plugin_register_init_concurrent(). */
+typedef struct {
+  char *depends_on;
+} init_options_t;
+
+/* One init callback of a group of concurrent init callbacks, see
+ * plugin_init_concurrent(). */
+typedef struct {
+  char *name;
+  callback_func_t *cf;
+  size_t *depends;
+  size_t depends_num;
+  bool started;
+  bool done;
+  int status;
+  cdtime_t duration;
+} init_task_t;
+
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  init_task_t *tasks;
+  size_t tasks_num;
+  size_t started_num;
+  size_t running_num;
+} init_group_t;
+
 static size_t list_cache_event_num;
 static cache_event_func_t list_cache_event[32];
 
 static fc_chain_t *pre_cache_chain;
 static fc_chain_t *post_cache_chain;
+/* Held for writing while cf_reload() rebuilds the filter chains. */
+static pthread_rwlock_t chain_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/* Maps type names to data_set_entry_t. Entries are never removed before
+ * shutdown, so a type keeps its handle when it is unregistered. `ds_entries'
+ * is indexed by handle. `ds_index' is an open addressing hash table (linear
+ * probing, at most half full) over the same entries, keyed by hash_name() of
+ * the type, used to look up types by name. */
+struct data_set_entry_s {
+  data_set_t *ds; /* NULL if the type has been unregistered */
+  ds_plan_t *plan; /* conversion plan of `ds' */
+  ds_handle_t handle;
+  uint64_t hash;
+  char type[DATA_MAX_NAME_LEN];
+};
+typedef struct data_set_entry_s data_set_entry_t;
 
-static c_avl_tree_t *data_sets;
+static data_set_entry_t **ds_entries;
+static size_t ds_entries_num;
+static data_set_entry_t **ds_index;
+static size_t ds_index_size; /* zero or a power of two */
 
 static char *plugindir;
 
+#ifndef WRITE_BATCH_DEFAULT_SIZE
+#define WRITE_BATCH_DEFAULT_SIZE 512
+#endif
+#ifndef WRITE_BATCH_DEFAULT_MAX_AGE
+#define WRITE_BATCH_DEFAULT_MAX_AGE TIME_T_TO_CDTIME_T_STATIC(1)
+#endif
+
 #ifndef DEFAULT_MAX_READ_INTERVAL
 #define DEFAULT_MAX_READ_INTERVAL TIME_T_TO_CDTIME_T_STATIC(86400)
 #endif
-static c_heap_t *read_heap;
+
+/* Rates are attached to value lists with at most this many values. */
+#define DISPATCH_RATES_MAX 16
+/* Read functions are kept in `read_heap' until the read threads are started
+ * (or until plugin_read_all_once() runs them). Afterwards every read thread
+ * has a schedule of its own, and a thread whose next read function is not due
+ * yet takes over due read functions from the other threads. */
+struct read_sched_s {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  c_timeheap_t *heap; /* keyed by `rf_next_read' */
+  size_t rf_num;      /* number of read functions in `heap' */
+};
+typedef struct read_sched_s read_sched_t;
+
+static c_timeheap_t *read_heap;
 static llist_t *read_list;
 static int read_loop = 1;
 static pthread_mutex_t read_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t read_cond = PTHREAD_COND_INITIALIZER;
 static pthread_t *read_threads;
 static size_t read_threads_num;
+static read_sched_t *read_scheds;
+static size_t read_scheds_num;
+/* Protected by `read_lock'. */
+static read_group_t **read_groups;
+static size_t read_groups_num;
+static bool read_spread;
 static cdtime_t max_read_interval = DEFAULT_MAX_READ_INTERVAL;
 
 static write_queue_t *write_queue_head;
 static write_queue_t *write_queue_tail;
+/* Dispatch time of the value list the calling thread is currently passing
+ * through the filter chains, see write_queue_t. */
+static __thread cdtime_t write_dispatched;
+/* Number of value lists the calling thread has queued so far, see
+ * plugin_bench_all(). */
+static __thread uint64_t write_enqueued;
 static long write_queue_length;
+/* Used instead of the linked list above if "WriteQueueType" is "Ring". */
+static c_ring_t *write_ring;
 static bool write_loop = true;
 static pthread_mutex_t write_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t write_cond = PTHREAD_COND_INITIALIZER;
 static pthread_t *write_threads;
 static size_t write_threads_num;
 
+/* Disk spool the write queue overflows into, see "WriteQueueSpool". While
+ * `write_spool_active' is set, all value lists are appended to the spool, so
+ * they reach the writers in the order they were dispatched. The replay thread
+ * moves them back to the queue whenever it is shorter than `write_spool_low'
+ * and clears the flag once the spool is empty. Setting the flag and
+ * appending, and clearing it, happen under `write_spool_lock'. */
+static c_spool_t *write_spool;
+static bool write_spool_active;
+static long write_spool_high;
+static long write_spool_low;
+static double write_spool_rate; /* value lists per second, zero = no limit */
+static bool write_spool_loop = true;
+static pthread_mutex_t write_spool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t write_spool_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t write_spool_thread;
+static bool write_spool_thread_running;
+static derive_t stats_values_spooled;
+static c_complain_t write_spool_complaint = C_COMPLAIN_INIT_STATIC;
+
+/* Post-cache filter threads, see "FilterThreads". */
+struct filter_shard_s {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  write_queue_t *head;
+  write_queue_t *tail;
+  pthread_t thread;
+};
+typedef struct filter_shard_s filter_shard_t;
+
+static filter_shard_t *filter_shards;
+static size_t filter_shards_num;
+static bool filter_loop = true;
+static long filter_queue_length;
+
+/* Notifications waiting for the notification threads, see
+ * "NotificationThreads". Each queued notification is a single allocation:
+ * the meta data and its strings are stored inline, behind the notification.
+ * It is immutable once queued and shared by all notification callbacks. */
+struct queued_notification_s;
+typedef struct queued_notification_s queued_notification_t;
+struct queued_notification_s {
+  notification_t n;
+  plugin_ctx_t ctx;
+  /* identifier, only set if the notification may be coalesced */
+  char *key;
+  queued_notification_t *prev;
+  queued_notification_t *next;
+  notification_meta_t meta[];
+};
+
+static queued_notification_t *notif_queue_head;
+static queued_notification_t *notif_queue_tail;
+static long notif_queue_length;
+static long notif_queue_limit;
+/* Maps identifiers to queued notifications if "NotificationCoalesce" is
+ * enabled. */
+static c_avl_tree_t *notif_pending;
+static bool notif_loop = true;
+static pthread_mutex_t notif_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t notif_cond = PTHREAD_COND_INITIALIZER;
+static c_complain_t notif_queue_complaint = C_COMPLAIN_INIT_STATIC;
+static pthread_t *notif_threads;
+static size_t notif_threads_num;
+static derive_t stats_notifications_dropped;
+static derive_t stats_notifications_coalesced;
+
 static pthread_key_t plugin_ctx_key;
 static bool plugin_ctx_key_initialized;
 
 static long write_limit_high;
 static long write_limit_low;
+/* "WriteQueuePolicy Stretch": read plugins of low priority less often
+ * instead of dropping values between the low and high water marks. */
+static bool write_queue_stretch;
+static cdtime_t write_latency_limit;
+/* Time the last value list spent in the global write queue. Only measured
+ * if "WriteQueueLatencyLimit" is set or statistics are recorded. */
+static cdtime_t write_latency;
+static bool write_overloaded;
 
 static pthread_mutex_t statistics_lock = PTHREAD_MUTEX_INITIALIZER;
 static derive_t stats_values_dropped;
+static derive_t stats_values_suppressed;
 static bool record_statistics;
 
+/* "CacheFile" and "CacheFileInterval", see uc_save_file(). */
+static char *cache_file;
+static cdtime_t cache_file_interval;
+static cdtime_t cache_file_next;
+
 /*
  * Static functions
  */
-static int plugin_dispatch_values_internal(value_list_t *vl);
+static int plugin_dispatch_values_internal(value_list_t *vl,
+                                           data_set_t const *ds);
+static void plugin_dispatch_post_cache(data_set_t const *ds, value_list_t *vl);
 
 static const char *plugin_get_dir(void) {
   if (plugindir == NULL)
@@ -173,8 +468,266 @@ static const char *plugin_get_dir(void) {
     return plugindir;
 }
 
+#define READ_STRETCH_MAX 16
+/* Maximum number of read functions passed to a read group callback at once. */
+#define READ_GROUP_MAX 256
+
+static long plugin_write_queue_length(void) /* {{{ */
+{
+  long length;
+
+  /* Value lists waiting for the post-cache chain, see "FilterThreads". */
+  length = __atomic_load_n(&filter_queue_length, __ATOMIC_RELAXED);
+
+  if (write_ring != NULL)
+    return length + (long)c_ring_size(write_ring);
+
+  pthread_mutex_lock(&write_lock);
+  length += write_queue_length;
+  pthread_mutex_unlock(&write_lock);
+
+  return length;
+} /* }}} long plugin_write_queue_length */
+
+/* Returns true if the write queue is long or slow enough for read callbacks of
+ * low priority to be stretched, see "WriteQueuePolicy". */
+static bool plugin_write_overloaded(void) /* {{{ */
+{
+  if (!write_queue_stretch)
+    return false;
+
+  long length = (write_limit_high > 0) ? plugin_write_queue_length() : 0;
+  cdtime_t latency = __atomic_load_n(&write_latency, __ATOMIC_RELAXED);
+
+  bool overloaded =
+      ((length > 0) && (length >= write_limit_low)) ||
+      ((write_latency_limit > 0) && (latency > write_latency_limit));
+
+  /* Only log changes, the read threads check this before every read. */
+  if (__atomic_exchange_n(&write_overloaded, overloaded, __ATOMIC_RELAXED) ==
+      overloaded)
+    return overloaded;
+
+  if (overloaded)
+    WARNING("plugin_read_thread: The write queue is overloaded (%ld metrics, "
+            "%.3f seconds). Reading plugins of low priority less often.",
+            length, CDTIME_T_TO_DOUBLE(latency));
+  else
+    NOTICE("plugin_read_thread: The write queue has recovered. Reading all "
+           "plugins at their intervals again.");
+  return overloaded;
+} /* }}} bool plugin_write_overloaded */
+
+static callback_stats_t *callback_stats_create(bool age) /* {{{ */
+{
+  callback_stats_t *st = calloc(1, sizeof(*st));
+  if (st == NULL)
+    return NULL;
+
+  st->latency = latency_counter_create();
+  if (age)
+    st->age = latency_counter_create();
+  if ((st->latency == NULL) || (age && (st->age == NULL))) {
+    latency_counter_destroy(st->latency);
+    latency_counter_destroy(st->age);
+    sfree(st);
+    return NULL;
+  }
+  pthread_mutex_init(&st->lock, /* attr = */ NULL);
+
+  return st;
+} /* }}} callback_stats_t *callback_stats_create */
+
+static void callback_stats_destroy(callback_stats_t *st) /* {{{ */
+{
+  if (st == NULL)
+    return;
+
+  latency_counter_destroy(st->latency);
+  latency_counter_destroy(st->age);
+  pthread_mutex_destroy(&st->lock);
+  sfree(st);
+} /* }}} void callback_stats_destroy */
+
+/* Attaches statistics to `cf' if internal statistics are being collected.
+ * With `age', the age of the values passed to the callback is recorded, too. */
+static void callback_stats_attach(callback_func_t *cf, bool age) /* {{{ */
+{
+  if (!record_statistics || (cf->cf_stats != NULL))
+    return;
+
+  cf->cf_stats = callback_stats_create(age);
+  if (cf->cf_stats == NULL)
+    ERROR("plugin: callback_stats_create failed.");
+} /* }}} void callback_stats_attach */
+
+/* CPU time consumed by the calling thread so far. */
+static cdtime_t thread_cpu_time(void) /* {{{ */
+{
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_THREAD_CPUTIME_ID)
+  struct timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+    return TIMESPEC_TO_CDTIME_T(&ts);
+#endif
+  return 0;
+} /* }}} cdtime_t thread_cpu_time */
+
+typedef struct {
+  cdtime_t time;
+  cdtime_t cpu_time;
+} callback_stats_mark_t;
+
+/* Call before invoking a callback ... */
+static void callback_stats_begin(callback_stats_t const *st, /* {{{ */
+                                 callback_stats_mark_t *m) {
+  if (st == NULL)
+    return;
+
+  m->time = cdtime();
+  m->cpu_time = thread_cpu_time();
+} /* }}} void callback_stats_begin */
+
+/* Records the age of a value list dispatched at `dispatched' when the
+ * callback, started at `m', is called with it. */
+static void callback_stats_age(callback_stats_t *st, /* {{{ */
+                               callback_stats_mark_t const *m,
+                               cdtime_t dispatched) {
+  if ((st == NULL) || (st->age == NULL) || (dispatched == 0) ||
+      (dispatched >= m->time))
+    return;
+
+  pthread_mutex_lock(&st->lock);
+  latency_counter_add(st->age, m->time - dispatched);
+  pthread_mutex_unlock(&st->lock);
+} /* }}} void callback_stats_age */
+
+/* ... and this afterwards, from the same thread. */
+static void callback_stats_end(callback_stats_t *st, /* {{{ */
+                               callback_stats_mark_t const *m) {
+  if (st == NULL)
+    return;
+
+  cdtime_t elapsed = cdtime() - m->time;
+  cdtime_t cpu_time = thread_cpu_time() - m->cpu_time;
+
+  pthread_mutex_lock(&st->lock);
+  latency_counter_add(st->latency, elapsed);
+  st->calls++;
+  st->cpu_time += cpu_time;
+  pthread_mutex_unlock(&st->lock);
+} /* }}} void callback_stats_end */
+
+typedef struct {
+  char name[DATA_MAX_NAME_LEN];
+  size_t num;
+  gauge_t average;
+  gauge_t max;
+  gauge_t percentile_50;
+  gauge_t percentile_99;
+  derive_t calls;
+  derive_t cpu_time_ms;
+  bool has_age;
+  gauge_t age_average;
+  gauge_t age_max;
+  gauge_t age_percentile_50;
+  gauge_t age_percentile_99;
+} callback_stats_report_t;
+
+/* Copies the statistics of `st' into `r' and resets the latency counter. */
+static void callback_stats_read(callback_stats_t *st, /* {{{ */
+                                callback_stats_report_t *r) {
+  pthread_mutex_lock(&st->lock);
+  r->num = latency_counter_get_num(st->latency);
+  r->average = CDTIME_T_TO_DOUBLE(latency_counter_get_average(st->latency));
+  r->max = CDTIME_T_TO_DOUBLE(latency_counter_get_max(st->latency));
+  r->percentile_50 =
+      CDTIME_T_TO_DOUBLE(latency_counter_get_percentile(st->latency, 50.0));
+  r->percentile_99 =
+      CDTIME_T_TO_DOUBLE(latency_counter_get_percentile(st->latency, 99.0));
+  r->calls = st->calls;
+  r->cpu_time_ms = (derive_t)CDTIME_T_TO_MS(st->cpu_time);
+  latency_counter_reset(st->latency);
+
+  size_t age_num = 0;
+  if (st->age != NULL) {
+    r->has_age = true;
+    age_num = latency_counter_get_num(st->age);
+    r->age_average = CDTIME_T_TO_DOUBLE(latency_counter_get_average(st->age));
+    r->age_max = CDTIME_T_TO_DOUBLE(latency_counter_get_max(st->age));
+    r->age_percentile_50 =
+        CDTIME_T_TO_DOUBLE(latency_counter_get_percentile(st->age, 50.0));
+    r->age_percentile_99 =
+        CDTIME_T_TO_DOUBLE(latency_counter_get_percentile(st->age, 99.0));
+    latency_counter_reset(st->age);
+  }
+  pthread_mutex_unlock(&st->lock);
+
+  if (r->num == 0) {
+    r->average = NAN;
+    r->max = NAN;
+    r->percentile_50 = NAN;
+    r->percentile_99 = NAN;
+  }
+  if (r->has_age && (age_num == 0)) {
+    r->age_average = NAN;
+    r->age_max = NAN;
+    r->age_percentile_50 = NAN;
+    r->age_percentile_99 = NAN;
+  }
+} /* }}} void callback_stats_read */
+
+static void callback_stats_dispatch(value_list_t *vl, /* {{{ */
+                                    char const *kind,
+                                    callback_stats_report_t const *r) {
+  ssnprintf(vl->plugin_instance, sizeof(vl->plugin_instance), "%s-%s", kind,
+            r->name);
+  vl->values_len = 1;
+
+  struct {
+    char const *type;
+    char const *type_instance;
+    value_t value;
+  } values[] = {
+      {"latency", "average", {.gauge = r->average}},
+      {"latency", "max", {.gauge = r->max}},
+      {"latency", "percentile-50", {.gauge = r->percentile_50}},
+      {"latency", "percentile-99", {.gauge = r->percentile_99}},
+      {"derive", "calls", {.derive = r->calls}},
+      {"total_time_in_ms", "cpu", {.derive = r->cpu_time_ms}},
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(values); i++) {
+    vl->values = &values[i].value;
+    sstrncpy(vl->type, values[i].type, sizeof(vl->type));
+    sstrncpy(vl->type_instance, values[i].type_instance,
+             sizeof(vl->type_instance));
+    plugin_dispatch_values(vl);
+  }
+
+  if (!r->has_age)
+    return;
+
+  struct {
+    char const *type_instance;
+    gauge_t value;
+  } ages[] = {
+      {"age-average", r->age_average},
+      {"age-max", r->age_max},
+      {"age-percentile-50", r->age_percentile_50},
+      {"age-percentile-99", r->age_percentile_99},
+  };
+
+  sstrncpy(vl->type, "latency", sizeof(vl->type));
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(ages); i++) {
+    vl->values = &(value_t){.gauge = ages[i].value};
+    sstrncpy(vl->type_instance, ages[i].type_instance,
+             sizeof(vl->type_instance));
+    plugin_dispatch_values(vl);
+  }
+} /* }}} void callback_stats_dispatch */
+
 static int plugin_update_internal_statistics(void) { /* {{{ */
-  gauge_t copy_write_queue_length = (gauge_t)write_queue_length;
+  gauge_t copy_write_queue_length = (gauge_t)plugin_write_queue_length();
 
   /* Initialize `vl' */
   value_list_t vl = VALUE_LIST_INIT;
@@ -198,6 +751,138 @@ static int plugin_update_internal_statistics(void) { /* {{{ */
   sstrncpy(vl.type_instance, "dropped", sizeof(vl.type_instance));
   plugin_dispatch_values(&vl);
 
+  /* Write queue : Values written to the disk spool */
+  if (write_spool != NULL) {
+    vl.values = &(value_t){.derive = __atomic_load_n(&stats_values_spooled,
+                                                     __ATOMIC_RELAXED)};
+    vl.values_len = 1;
+    sstrncpy(vl.type, "derive", sizeof(vl.type));
+    sstrncpy(vl.type_instance, "spooled", sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+
+    vl.values = &(value_t){.gauge = (gauge_t)c_spool_records(write_spool)};
+    vl.values_len = 1;
+    sstrncpy(vl.type, "queue_length", sizeof(vl.type));
+    sstrncpy(vl.type_instance, "spool", sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+
+    vl.values = &(value_t){.gauge = (gauge_t)c_spool_size(write_spool)};
+    vl.values_len = 1;
+    sstrncpy(vl.type, "bytes", sizeof(vl.type));
+    sstrncpy(vl.type_instance, "spool", sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+
+    /* Records dropped because the spool was full. */
+    vl.values = &(value_t){.derive = (derive_t)c_spool_dropped(write_spool)};
+    vl.values_len = 1;
+    sstrncpy(vl.type, "derive", sizeof(vl.type));
+    sstrncpy(vl.type_instance, "spool_dropped", sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+  }
+
+  /* Write queue : Unchanged values kept from the writers */
+  vl.values = &(value_t){.derive = __atomic_load_n(&stats_values_suppressed,
+                                                   __ATOMIC_RELAXED)};
+  vl.values_len = 1;
+  sstrncpy(vl.type, "derive", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "suppressed", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  /* Notification queue */
+  if (notif_threads_num > 0) {
+    pthread_mutex_lock(&notif_lock);
+    gauge_t queue_length = (gauge_t)notif_queue_length;
+    derive_t dropped = stats_notifications_dropped;
+    derive_t coalesced = stats_notifications_coalesced;
+    pthread_mutex_unlock(&notif_lock);
+
+    sstrncpy(vl.plugin_instance, "notification_queue",
+             sizeof(vl.plugin_instance));
+
+    vl.values = &(value_t){.gauge = queue_length};
+    vl.values_len = 1;
+    sstrncpy(vl.type, "queue_length", sizeof(vl.type));
+    vl.type_instance[0] = 0;
+    plugin_dispatch_values(&vl);
+
+    vl.values = &(value_t){.derive = dropped};
+    vl.values_len = 1;
+    sstrncpy(vl.type, "derive", sizeof(vl.type));
+    sstrncpy(vl.type_instance, "dropped", sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+
+    vl.values = &(value_t){.derive = coalesced};
+    vl.values_len = 1;
+    sstrncpy(vl.type, "derive", sizeof(vl.type));
+    sstrncpy(vl.type_instance, "coalesced", sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+  }
+
+  /* Private queues of write plugins */
+  for (llentry_t *le = llist_head(list_write); le != NULL; le = le->next) {
+    write_func_t *wf = le->value;
+    if (wf->wf_threads_num == 0)
+      continue;
+
+    pthread_mutex_lock(&wf->wf_lock);
+    gauge_t queue_length = (gauge_t)wf->wf_queue_length;
+    derive_t dropped = wf->wf_dropped;
+    pthread_mutex_unlock(&wf->wf_lock);
+
+    ssnprintf(vl.plugin_instance, sizeof(vl.plugin_instance), "write_queue-%s",
+              le->key);
+
+    vl.values = &(value_t){.gauge = queue_length};
+    vl.values_len = 1;
+    sstrncpy(vl.type, "queue_length", sizeof(vl.type));
+    vl.type_instance[0] = 0;
+    plugin_dispatch_values(&vl);
+
+    vl.values = &(value_t){.derive = dropped};
+    vl.values_len = 1;
+    sstrncpy(vl.type, "derive", sizeof(vl.type));
+    sstrncpy(vl.type_instance, "dropped", sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+  }
+
+  /* Write callbacks : latency and CPU time */
+  for (llentry_t *le = llist_head(list_write); le != NULL; le = le->next) {
+    write_func_t *wf = le->value;
+    if (wf->wf_stats == NULL)
+      continue;
+
+    callback_stats_report_t r = {0};
+    sstrncpy(r.name, le->key, sizeof(r.name));
+    callback_stats_read(wf->wf_stats, &r);
+    callback_stats_dispatch(&vl, "write", &r);
+  }
+
+  /* Read callbacks : latency and CPU time. The statistics are copied first,
+   * so `read_lock' is not held while dispatching. */
+  callback_stats_report_t *reports = NULL;
+  size_t reports_num = 0;
+
+  pthread_mutex_lock(&read_lock);
+  int read_num = (read_list != NULL) ? llist_size(read_list) : 0;
+  if (read_num > 0)
+    reports = calloc((size_t)read_num, sizeof(*reports));
+  for (llentry_t *le = (reports != NULL) ? llist_head(read_list) : NULL;
+       le != NULL; le = le->next) {
+    read_func_t *rf = le->value;
+    if (rf->rf_stats == NULL)
+      continue;
+
+    callback_stats_report_t *r = reports + reports_num;
+    sstrncpy(r->name, rf->rf_name, sizeof(r->name));
+    callback_stats_read(rf->rf_stats, r);
+    reports_num++;
+  }
+  pthread_mutex_unlock(&read_lock);
+
+  for (size_t i = 0; i < reports_num; i++)
+    callback_stats_dispatch(&vl, "read", reports + i);
+  sfree(reports);
+
   /* Cache */
   sstrncpy(vl.plugin_instance, "cache", sizeof(vl.plugin_instance));
 
@@ -208,6 +893,25 @@ static int plugin_update_internal_statistics(void) { /* {{{ */
   vl.type_instance[0] = 0;
   plugin_dispatch_values(&vl);
 
+  /* Memory held in containers, per plugin */
+  memstats_report_t mem[MEMSTATS_OWNERS_MAX];
+  size_t mem_num = memstats_read(mem, STATIC_ARRAY_SIZE(mem));
+  if (mem_num > STATIC_ARRAY_SIZE(mem))
+    mem_num = STATIC_ARRAY_SIZE(mem);
+  vl.type_instance[0] = 0;
+  for (size_t i = 0; i < mem_num; i++) {
+    ssnprintf(vl.plugin_instance, sizeof(vl.plugin_instance), "memory-%s",
+              mem[i].name);
+
+    vl.values = &(value_t){.gauge = (gauge_t)mem[i].bytes};
+    sstrncpy(vl.type, "memory", sizeof(vl.type));
+    plugin_dispatch_values(&vl);
+
+    vl.values = &(value_t){.gauge = (gauge_t)mem[i].objects};
+    sstrncpy(vl.type, "objects", sizeof(vl.type));
+    plugin_dispatch_values(&vl);
+  }
+
   return 0;
 } /* }}} int plugin_update_internal_statistics */
 
@@ -226,6 +930,7 @@ static void destroy_callback(callback_func_t *cf) /* {{{ */
   if (cf == NULL)
     return;
   free_userdata(&cf->cf_udata);
+  callback_stats_destroy(cf->cf_stats);
   sfree(cf);
 } /* }}} void destroy_callback */
 
@@ -261,23 +966,25 @@ static void destroy_read_heap(void) /* {{{ */
   while (42) {
     read_func_t *rf;
 
-    rf = c_heap_get_root(read_heap);
+    rf = c_timeheap_get_root(read_heap, NULL);
     if (rf == NULL)
       break;
     sfree(rf->rf_name);
     destroy_callback((callback_func_t *)rf);
   }
 
-  c_heap_destroy(read_heap);
+  c_timeheap_destroy(read_heap);
   read_heap = NULL;
 } /* }}} void destroy_read_heap */
 
 static int register_callback(llist_t **list, /* {{{ */
                              const char *name, callback_func_t *cf) {
+  pthread_mutex_lock(&register_lock);
 
   if (*list == NULL) {
     *list = llist_create();
     if (*list == NULL) {
+      pthread_mutex_unlock(&register_lock);
       ERROR("plugin: register_callback: "
             "llist_create failed.");
       destroy_callback(cf);
@@ -287,6 +994,7 @@ static int register_callback(llist_t **list, /* {{{ */
 
   char *key = strdup(name);
   if (key == NULL) {
+    pthread_mutex_unlock(&register_lock);
     ERROR("plugin: register_callback: strdup failed.");
     destroy_callback(cf);
     return -1;
@@ -296,6 +1004,7 @@ static int register_callback(llist_t **list, /* {{{ */
   if (le == NULL) {
     le = llentry_create(key, cf);
     if (le == NULL) {
+      pthread_mutex_unlock(&register_lock);
       ERROR("plugin: register_callback: "
             "llentry_create failed.");
       sfree(key);
@@ -304,9 +1013,11 @@ static int register_callback(llist_t **list, /* {{{ */
     }
 
     llist_append(*list, le);
+    pthread_mutex_unlock(&register_lock);
   } else {
     callback_func_t *old_cf = le->value;
     le->value = cf;
+    pthread_mutex_unlock(&register_lock);
 
     P_WARNING("register_callback: "
               "a callback named `%s' already exists - "
@@ -392,11 +1103,15 @@ static int plugin_unregister(llist_t *list, const char *name) /* {{{ */
   if (list == NULL)
     return -1;
 
+  pthread_mutex_lock(&register_lock);
   e = llist_search(list, name);
-  if (e == NULL)
+  if (e == NULL) {
+    pthread_mutex_unlock(&register_lock);
     return -1;
+  }
 
   llist_remove(list, e);
+  pthread_mutex_unlock(&register_lock);
 
   sfree(e->key);
   destroy_callback(e->value);
@@ -406,6 +1121,28 @@ static int plugin_unregister(llist_t *list, const char *name) /* {{{ */
   return 0;
 } /* }}} int plugin_unregister */
 
+/* Points the handles called `name', or all handles if `name' is NULL, to the
+ * first write callback of that name other than `removed'. Names are compared
+ * case-insensitively, like plugin_write() does. */
+static void write_handles_resolve(char const *name, /* {{{ */
+                                  write_func_t const *removed) {
+  pthread_mutex_lock(&register_lock);
+  for (plugin_write_handle_t *h = write_handles; h != NULL; h = h->next) {
+    if ((name != NULL) && (strcasecmp(name, h->name) != 0))
+      continue;
+
+    write_func_t *wf = NULL;
+    for (llentry_t *le = llist_head(list_write); le != NULL; le = le->next) {
+      if ((le->value != removed) && (strcasecmp(h->name, le->key) == 0)) {
+        wf = le->value;
+        break;
+      }
+    }
+    __atomic_store_n(&h->wf, wf, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&register_lock);
+} /* }}} void write_handles_resolve */
+
 /* plugin_load_file loads the shared object "file" and calls its
  * "module_register" function. Returns zero on success, non-zero otherwise. */
 static int plugin_load_file(char const *file, bool global) {
@@ -447,62 +1184,346 @@ static int plugin_load_file(char const *file, bool global) {
   return 0;
 }
 
-static void *plugin_read_thread(void __attribute__((unused)) * args) {
+/* Returns the offset by which the first read of `rf' is delayed if
+ * "SpreadReads" is enabled. It is derived from the name, so it is stable
+ * across restarts and spreads read functions with the same interval evenly. */
+static cdtime_t read_spread_offset(read_func_t const *rf) {
+  if (!read_spread || (rf->rf_interval == 0))
+    return 0;
+  return (cdtime_t)(hash_name(rf->rf_name) % rf->rf_interval);
+} /* cdtime_t read_spread_offset */
+
+/* Adds `rf' to the schedule `s' and wakes up its thread. Must hold `s->lock'
+ * when calling. */
+static int read_sched_insert(read_sched_t *s, read_func_t *rf) {
+  int status = c_timeheap_insert(s->heap, rf->rf_next_read, rf);
+  if (status != 0)
+    return status;
+
+  __atomic_add_fetch(&s->rf_num, 1, __ATOMIC_RELAXED);
+  pthread_cond_signal(&s->cond);
+  return 0;
+} /* int read_sched_insert */
+
+/* Returns the schedule with the fewest read functions, or NULL if the read
+ * threads are not running. */
+static read_sched_t *read_sched_least_loaded(void) {
+  size_t scheds_num = __atomic_load_n(&read_scheds_num, __ATOMIC_ACQUIRE);
+  read_sched_t *ret = NULL;
+
+  for (size_t i = 0; i < scheds_num; i++) {
+    if ((ret == NULL) ||
+        (__atomic_load_n(&read_scheds[i].rf_num, __ATOMIC_RELAXED) <
+         __atomic_load_n(&ret->rf_num, __ATOMIC_RELAXED)))
+      ret = read_scheds + i;
+  }
+
+  return ret;
+} /* read_sched_t *read_sched_least_loaded */
+
+/* Removes and returns the next read function of `s' if it is due at `now'. */
+static read_func_t *read_sched_get_due(read_sched_t *s, cdtime_t now) {
+  read_func_t *rf;
+  cdtime_t next_read;
+
+  pthread_mutex_lock(&s->lock);
+  rf = c_timeheap_peek_root(s->heap, &next_read);
+  if ((rf != NULL) && (next_read <= now)) {
+    rf = c_timeheap_get_root(s->heap, NULL);
+    __atomic_sub_fetch(&s->rf_num, 1, __ATOMIC_RELAXED);
+  } else {
+    rf = NULL;
+  }
+  pthread_mutex_unlock(&s->lock);
+
+  return rf;
+} /* read_func_t *read_sched_get_due */
+
+/* If schedule `behind' has more read functions that are due at `now', wakes up
+ * the thread following `self' so that it can steal one of them. */
+static void read_sched_kick(size_t self, size_t behind, cdtime_t now) {
+  size_t scheds_num = __atomic_load_n(&read_scheds_num, __ATOMIC_ACQUIRE);
+  if (scheds_num < 2)
+    return;
+
+  read_sched_t *s = read_scheds + behind;
+  cdtime_t next_read;
+  pthread_mutex_lock(&s->lock);
+  bool is_behind = (c_timeheap_peek_root(s->heap, &next_read) != NULL) &&
+                   (next_read <= now);
+  pthread_mutex_unlock(&s->lock);
+  if (!is_behind)
+    return;
+
+  size_t next = (self + 1) % scheds_num;
+  if (next == behind)
+    next = (next + 1) % scheds_num;
+  if (next == self)
+    return;
+
+  s = read_scheds + next;
+  pthread_mutex_lock(&s->lock);
+  pthread_cond_signal(&s->cond);
+  pthread_mutex_unlock(&s->lock);
+} /* void read_sched_kick */
+
+/* Takes a read function that is due at `now' from another read thread and
+ * stores that thread's schedule in `ret_from'. */
+static read_func_t *read_sched_steal(size_t self, cdtime_t now,
+                                     read_sched_t **ret_from) {
+  size_t scheds_num = __atomic_load_n(&read_scheds_num, __ATOMIC_ACQUIRE);
+
+  for (size_t i = 1; i < scheds_num; i++) {
+    size_t victim = (self + i) % scheds_num;
+    read_func_t *rf = read_sched_get_due(read_scheds + victim, now);
+    if (rf == NULL)
+      continue;
+
+    DEBUG("plugin_read_thread: reader#%" PRIsz " took over `%s' from "
+          "reader#%" PRIsz ".",
+          self, rf->rf_name, victim);
+    read_sched_kick(self, victim, now);
+    *ret_from = read_scheds + victim;
+    return rf;
+  }
+
+  return NULL;
+} /* read_func_t *read_sched_steal */
+
+/* Stores `rf' and the other read functions of its group that are due within
+ * the group's window in `batch', taking the latter out of schedule `s'.
+ * Returns the number of read functions in `batch'. */
+static size_t read_sched_get_group(read_sched_t *s, read_func_t *rf,
+                                   read_group_t *rg, cdtime_t now,
+                                   read_func_t **batch) {
+  read_func_t *others[READ_GROUP_MAX];
+  size_t others_num = 0;
+  size_t batch_num = 0;
+
+  batch[batch_num++] = rf;
+
+  pthread_mutex_lock(&s->lock);
+  while ((batch_num < READ_GROUP_MAX) && (others_num < READ_GROUP_MAX)) {
+    cdtime_t next_read;
+    read_func_t *next = c_timeheap_peek_root(s->heap, &next_read);
+    if ((next == NULL) || (next_read > now + rg->window))
+      break;
+
+    c_timeheap_get_root(s->heap, NULL);
+    if ((__atomic_load_n(&next->rf_read_group, __ATOMIC_ACQUIRE) == rg) &&
+        (__atomic_load_n(&next->rf_type, __ATOMIC_ACQUIRE) == RF_COMPLEX)) {
+      batch[batch_num++] = next;
+      __atomic_sub_fetch(&s->rf_num, 1, __ATOMIC_RELAXED);
+    } else {
+      others[others_num++] = next;
+    }
+  }
+
+  /* Put back what is not part of the batch. */
+  for (size_t i = 0; i < others_num; i++)
+    c_timeheap_insert(s->heap, others[i]->rf_next_read, others[i]);
+  pthread_mutex_unlock(&s->lock);
+
+  return batch_num;
+} /* size_t read_sched_get_group */
+
+/* Returns the interval `rf' is read with this time. Read plugins of low
+ * priority are read less often while the write queue is overloaded, doubling
+ * the interval with every read, and at their own interval again once it has
+ * recovered. The values report the stretched interval, so they are not
+ * considered missing. */
+static cdtime_t read_func_interval(read_func_t *rf) {
+  if (rf->rf_interval == 0) {
+    /* this should not happen, because the interval is set
+     * for each plugin when loading it
+     * XXX: issue a warning? */
+    rf->rf_interval = plugin_get_interval();
+    rf->rf_effective_interval = rf->rf_interval;
+  }
+
+  unsigned int stretch = 1;
+  if ((rf->rf_ctx.priority <= 0) && plugin_write_overloaded()) {
+    stretch = 2 * rf->rf_stretch;
+    if (stretch > READ_STRETCH_MAX)
+      stretch = READ_STRETCH_MAX;
+  }
+  if (stretch != rf->rf_stretch)
+    DEBUG("plugin_read_thread: Reading `%s' every %.3f seconds.", rf->rf_name,
+          CDTIME_T_TO_DOUBLE(stretch * rf->rf_interval));
+  rf->rf_stretch = stretch;
+
+  return rf->rf_stretch * rf->rf_interval;
+} /* cdtime_t read_func_interval */
+
+/* Accounts for a read of `rf' that ran from `start' to `now' and calculates
+ * the time of its next read. */
+static void read_func_done(read_func_t *rf, cdtime_t interval, int status,
+                           cdtime_t start, cdtime_t now, cdtime_t cpu_time) {
+  /* If the function signals failure, we will increase the
+   * intervals in which it will be called. */
+  if (status != 0) {
+    rf->rf_effective_interval *= 2;
+    if (rf->rf_effective_interval > max_read_interval)
+      rf->rf_effective_interval = max_read_interval;
+
+    NOTICE("read-function of plugin `%s' failed. "
+           "Will suspend it for %.3f seconds.",
+           rf->rf_name, CDTIME_T_TO_DOUBLE(rf->rf_effective_interval));
+  } else {
+    /* Success: Restore the interval, if it was changed. */
+    rf->rf_effective_interval = interval;
+  }
+
+  /* calculate the time spent in the read function */
+  cdtime_t elapsed = (now - start);
+  CD_PROBE3(read_end, rf->rf_name, status, elapsed);
+
+  if (rf->rf_stats != NULL) {
+    pthread_mutex_lock(&rf->rf_stats->lock);
+    latency_counter_add(rf->rf_stats->latency, elapsed);
+    rf->rf_stats->calls++;
+    rf->rf_stats->cpu_time += cpu_time;
+    pthread_mutex_unlock(&rf->rf_stats->lock);
+  }
+
+  if (elapsed > rf->rf_effective_interval)
+    WARNING(
+        "plugin_read_thread: read-function of the `%s' plugin took %.3f "
+        "seconds, which is above its read interval (%.3f seconds). You might "
+        "want to adjust the `Interval' or `ReadThreads' settings.",
+        rf->rf_name, CDTIME_T_TO_DOUBLE(elapsed),
+        CDTIME_T_TO_DOUBLE(rf->rf_effective_interval));
+
+  DEBUG("plugin_read_thread: read-function of the `%s' plugin took "
+        "%.6f seconds.",
+        rf->rf_name, CDTIME_T_TO_DOUBLE(elapsed));
+
+  DEBUG("plugin_read_thread: Effective interval of the "
+        "`%s' plugin is %.3f seconds.",
+        rf->rf_name, CDTIME_T_TO_DOUBLE(rf->rf_effective_interval));
+
+  /* Calculate the next (absolute) time at which this function
+   * should be called. */
+  rf->rf_next_read += rf->rf_effective_interval;
+
+  /* Check, if `rf_next_read' is in the past. */
+  if (rf->rf_next_read < now) {
+    /* `rf_next_read' is in the past. Insert `now'
+     * so this value doesn't trail off into the
+     * past too much. */
+    rf->rf_next_read = now;
+  }
+
+  DEBUG("plugin_read_thread: Next read of the `%s' plugin at %.3f.",
+        rf->rf_name, CDTIME_T_TO_DOUBLE(rf->rf_next_read));
+} /* void read_func_done */
+
+/* Reads the read functions in `batch', which belong to group `rg', with a
+ * single call of the group's callback and adds them to schedule `s'. */
+static void read_group_run(read_sched_t *s, read_group_t *rg,
+                           plugin_read_group_cb callback, read_func_t **batch,
+                           size_t batch_num) {
+  user_data_t *user_data[READ_GROUP_MAX];
+  cdtime_t intervals[READ_GROUP_MAX];
+  int status[READ_GROUP_MAX] = {0};
+
+  DEBUG("plugin_read_thread: Handling %" PRIsz " read functions of group "
+        "`%s'.",
+        batch_num, rg->group);
+
+  for (size_t i = 0; i < batch_num; i++) {
+    intervals[i] = read_func_interval(batch[i]);
+    user_data[i] = &batch[i]->rf_udata;
+    /* `batch[0]' is due first. Aligning the others to it keeps the group
+     * together in the following intervals. */
+    batch[i]->rf_next_read = batch[0]->rf_next_read;
+  }
+
+  /* The batch runs in the context of its first read function. */
+  plugin_ctx_t ctx = batch[0]->rf_ctx;
+  ctx.interval = intervals[0];
+
+  cdtime_t start = cdtime();
+  cdtime_t cpu_start = thread_cpu_time();
+
+  /* Values dispatched without a time stamp get the start of the read. */
+  cdtime_cache_set(start);
+  plugin_ctx_t old_ctx = plugin_set_ctx(ctx);
+
+  CD_PROBE1(read_start, rg->group);
+  int ret = (*callback)(user_data, status, batch_num);
+
+  plugin_set_ctx(old_ctx);
+  cdtime_cache_set(0);
+
+  cdtime_t now = cdtime();
+  cdtime_t cpu_time = (thread_cpu_time() - cpu_start) / batch_num;
+
+  for (size_t i = 0; i < batch_num; i++) {
+    if ((ret != 0) && (status[i] == 0))
+      status[i] = ret;
+    read_func_done(batch[i], intervals[i], status[i], start, now, cpu_time);
+  }
+
+  pthread_mutex_lock(&s->lock);
+  for (size_t i = 0; i < batch_num; i++)
+    read_sched_insert(s, batch[i]);
+  pthread_mutex_unlock(&s->lock);
+} /* void read_group_run */
+
+static void *plugin_read_thread(void *args) {
+  size_t self = (size_t)(uintptr_t)args;
+  read_sched_t *s = read_scheds + self;
+  /* Read function swapped out of the schedule when re-inserting the previous
+   * one, see below. */
+  read_func_t *next_rf = NULL;
+
   while (read_loop != 0) {
     read_func_t *rf;
+    read_sched_t *from = s;
     plugin_ctx_t old_ctx;
     cdtime_t start;
     cdtime_t now;
-    cdtime_t elapsed;
     int status;
     int rf_type;
-    int rc;
 
-    /* Get the read function that needs to be read next.
-     * We don't need to hold "read_lock" for the heap, but we need
-     * to call c_heap_get_root() and pthread_cond_wait() in the
-     * same protected block. */
-    pthread_mutex_lock(&read_lock);
-    rf = c_heap_get_root(read_heap);
+    /* Get the read function that needs to be read next: one of our own if it
+     * is due, otherwise one that another thread did not get to in time. */
+    now = cdtime();
+    rf = next_rf;
+    next_rf = NULL;
+    if (rf == NULL)
+      rf = read_sched_get_due(s, now);
+    if (rf != NULL)
+      read_sched_kick(self, self, now);
+    else
+      rf = read_sched_steal(self, now, &from);
+
     if (rf == NULL) {
-      pthread_cond_wait(&read_cond, &read_lock);
-      pthread_mutex_unlock(&read_lock);
+      /* Sleep until our next read function is due, a new one is added or
+       * another thread asks for help. Spurious wakeups are harmless, the
+       * schedule is simply re-evaluated. `read_loop' is checked while holding
+       * `s->lock' so the wakeup from stop_read_threads() cannot be missed. */
+      cdtime_t next_read;
+      pthread_mutex_lock(&s->lock);
+      if (read_loop == 0) {
+        /* shutting down */
+      } else if (c_timeheap_peek_root(s->heap, &next_read) == NULL) {
+        pthread_cond_wait(&s->cond, &s->lock);
+      } else if (next_read > cdtime()) {
+        pthread_cond_timedwait(&s->cond, &s->lock,
+                               &CDTIME_T_TO_TIMESPEC(next_read));
+      }
+      pthread_mutex_unlock(&s->lock);
       continue;
     }
-    pthread_mutex_unlock(&read_lock);
-
-    if (rf->rf_interval == 0) {
-      /* this should not happen, because the interval is set
-       * for each plugin when loading it
-       * XXX: issue a warning? */
-      rf->rf_interval = plugin_get_interval();
-      rf->rf_effective_interval = rf->rf_interval;
-
-      rf->rf_next_read = cdtime();
-    }
-
-    /* sleep until this entry is due,
-     * using pthread_cond_timedwait */
-    pthread_mutex_lock(&read_lock);
-    /* In pthread_cond_timedwait, spurious wakeups are possible
-     * (and really happen, at least on NetBSD with > 1 CPU), thus
-     * we need to re-evaluate the condition every time
-     * pthread_cond_timedwait returns. */
-    rc = 0;
-    while ((read_loop != 0) && (cdtime() < rf->rf_next_read) && rc == 0) {
-      rc = pthread_cond_timedwait(&read_cond, &read_lock,
-                                  &CDTIME_T_TO_TIMESPEC(rf->rf_next_read));
-    }
-
-    /* Must hold `read_lock' when accessing `rf->rf_type'. */
-    rf_type = rf->rf_type;
-    pthread_mutex_unlock(&read_lock);
 
-    /* Check if we're supposed to stop.. This may have interrupted
-     * the sleep, too. */
+    /* Check if we're supposed to stop. */
     if (read_loop == 0) {
       /* Insert `rf' again, so it can be free'd correctly */
-      c_heap_insert(read_heap, rf);
+      pthread_mutex_lock(&s->lock);
+      read_sched_insert(s, rf);
+      pthread_mutex_unlock(&s->lock);
       break;
     }
 
@@ -510,6 +1531,7 @@ static void *plugin_read_thread(void __attribute__((unused)) * args) {
      * entry has already been removed by `plugin_unregister_read'.
      * All we have to do here is free the `read_func_t' and
      * continue. */
+    rf_type = __atomic_load_n(&rf->rf_type, __ATOMIC_ACQUIRE);
     if (rf_type == RF_REMOVE) {
       DEBUG("plugin_read_thread: Destroying the `%s' "
             "callback.",
@@ -520,12 +1542,37 @@ static void *plugin_read_thread(void __attribute__((unused)) * args) {
       continue;
     }
 
+    /* Complex read functions of a group with a batch callback are read
+     * together with the other members that are due within the group's
+     * window. */
+    read_group_t *rg = NULL;
+    plugin_read_group_cb group_cb = NULL;
+    if (rf_type == RF_COMPLEX)
+      rg = __atomic_load_n(&rf->rf_read_group, __ATOMIC_ACQUIRE);
+    if (rg != NULL)
+      group_cb = __atomic_load_n(&rg->callback, __ATOMIC_ACQUIRE);
+    if (group_cb != NULL) {
+      read_func_t *batch[READ_GROUP_MAX];
+      size_t batch_num = read_sched_get_group(from, rf, rg, now, batch);
+      if (batch_num > 1) {
+        read_group_run(s, rg, group_cb, batch, batch_num);
+        continue;
+      }
+    }
+
     DEBUG("plugin_read_thread: Handling `%s'.", rf->rf_name);
 
+    plugin_ctx_t ctx = rf->rf_ctx;
+    ctx.interval = read_func_interval(rf);
+
     start = cdtime();
+    cdtime_t cpu_start = (rf->rf_stats != NULL) ? thread_cpu_time() : 0;
 
-    old_ctx = plugin_set_ctx(rf->rf_ctx);
+    /* Values dispatched without a time stamp get the start of the read. */
+    cdtime_cache_set(start);
+    old_ctx = plugin_set_ctx(ctx);
 
+    CD_PROBE1(read_start, rf->rf_name);
     if (rf_type == RF_SIMPLE) {
       int (*callback)(void);
 
@@ -541,63 +1588,35 @@ static void *plugin_read_thread(void __attribute__((unused)) * args) {
     }
 
     plugin_set_ctx(old_ctx);
-
-    /* If the function signals failure, we will increase the
-     * intervals in which it will be called. */
-    if (status != 0) {
-      rf->rf_effective_interval *= 2;
-      if (rf->rf_effective_interval > max_read_interval)
-        rf->rf_effective_interval = max_read_interval;
-
-      NOTICE("read-function of plugin `%s' failed. "
-             "Will suspend it for %.3f seconds.",
-             rf->rf_name, CDTIME_T_TO_DOUBLE(rf->rf_effective_interval));
-    } else {
-      /* Success: Restore the interval, if it was changed. */
-      rf->rf_effective_interval = rf->rf_interval;
-    }
+    cdtime_cache_set(0);
 
     /* update the ``next read due'' field */
     now = cdtime();
-
-    /* calculate the time spent in the read function */
-    elapsed = (now - start);
-
-    if (elapsed > rf->rf_effective_interval)
-      WARNING(
-          "plugin_read_thread: read-function of the `%s' plugin took %.3f "
-          "seconds, which is above its read interval (%.3f seconds). You might "
-          "want to adjust the `Interval' or `ReadThreads' settings.",
-          rf->rf_name, CDTIME_T_TO_DOUBLE(elapsed),
-          CDTIME_T_TO_DOUBLE(rf->rf_effective_interval));
-
-    DEBUG("plugin_read_thread: read-function of the `%s' plugin took "
-          "%.6f seconds.",
-          rf->rf_name, CDTIME_T_TO_DOUBLE(elapsed));
-
-    DEBUG("plugin_read_thread: Effective interval of the "
-          "`%s' plugin is %.3f seconds.",
-          rf->rf_name, CDTIME_T_TO_DOUBLE(rf->rf_effective_interval));
-
-    /* Calculate the next (absolute) time at which this function
-     * should be called. */
-    rf->rf_next_read += rf->rf_effective_interval;
-
-    /* Check, if `rf_next_read' is in the past. */
-    if (rf->rf_next_read < now) {
-      /* `rf_next_read' is in the past. Insert `now'
-       * so this value doesn't trail off into the
-       * past too much. */
-      rf->rf_next_read = now;
-    }
-
-    DEBUG("plugin_read_thread: Next read of the `%s' plugin at %.3f.",
-          rf->rf_name, CDTIME_T_TO_DOUBLE(rf->rf_next_read));
-
-    /* Re-insert this read function into the heap again. */
-    c_heap_insert(read_heap, rf);
+    cdtime_t cpu_time =
+        (rf->rf_stats != NULL) ? thread_cpu_time() - cpu_start : 0;
+    read_func_done(rf, ctx.interval, status, start, now, cpu_time);
+
+    /* Re-insert this read function into our schedule. If the next one is
+     * already due, take it out in the same step, so the heap is re-ordered
+     * only once. Read functions taken over from another thread stay with this
+     * thread from now on. */
+    cdtime_t next_read;
+    pthread_mutex_lock(&s->lock);
+    if ((c_timeheap_peek_root(s->heap, &next_read) != NULL) &&
+        (next_read <= now))
+      next_rf = c_timeheap_replace_root(s->heap, rf->rf_next_read, rf, NULL);
+    else
+      read_sched_insert(s, rf);
+    pthread_mutex_unlock(&s->lock);
   } /* while (read_loop) */
 
+  if (next_rf != NULL) {
+    /* Insert `next_rf' again, so it can be free'd correctly */
+    pthread_mutex_lock(&s->lock);
+    read_sched_insert(s, next_rf);
+    pthread_mutex_unlock(&s->lock);
+  }
+
   pthread_exit(NULL);
   return (void *)0;
 } /* void *plugin_read_thread */
@@ -630,36 +1649,161 @@ static void set_thread_name(pthread_t tid, char const *name) {
 #endif
 }
 
+/* CPUs the daemon's threads are pinned to, see the "ReadThreadCPUs" and
+ * "WriteThreadCPUs" options. Threads are assigned to the core groups round
+ * robin; `write_thread_cpus_next' counts all threads on the write side (write,
+ * filter and writer threads) so they are spread over the groups together. */
+static core_groups_list_t read_thread_cpus;
+static core_groups_list_t write_thread_cpus;
+static size_t write_thread_cpus_next;
+static size_t plugin_thread_cpus_next;
+
+/* Parses a CPU list in the format of utils/config_cores: "0-3" lets every
+ * thread run on CPUs 0 to 3, "[0-3]" pins each thread to one of them. */
+static int thread_cpus_parse(char const *option, /* {{{ */
+                             char const *value, core_groups_list_t *cgl) {
+  if ((value == NULL) || (value[0] == 0))
+    return 0;
+
+#if HAVE_PTHREAD_SETAFFINITY_NP
+  oconfig_value_t v = {.value.string = (char *)value,
+                       .type = OCONFIG_TYPE_STRING};
+  oconfig_item_t ci = {.key = (char *)option, .values = &v, .values_num = 1};
+
+  if (config_cores_parse(&ci, cgl) != 0) {
+    ERROR("plugin: Parsing %s \"%s\" failed.", option, value);
+    return -1;
+  }
+  return 0;
+#else
+  WARNING("plugin: %s is not supported on this platform.", option);
+  return 0;
+#endif
+} /* }}} int thread_cpus_parse */
+
+/* Pins "thread" to the core group "index" (modulo the number of groups). */
+static void thread_cpus_apply(pthread_t thread, /* {{{ */
+                              core_groups_list_t const *cgl, size_t index,
+                              char const *name) {
+#if HAVE_PTHREAD_SETAFFINITY_NP
+  if (cgl->num_cgroups == 0)
+    return;
+
+  core_group_t const *cg = cgl->cgroups + (index % cgl->num_cgroups);
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (size_t i = 0; i < cg->num_cores; i++)
+    if (cg->cores[i] < CPU_SETSIZE)
+      CPU_SET(cg->cores[i], &set);
+
+  int status = pthread_setaffinity_np(thread, sizeof(set), &set);
+  if (status != 0)
+    ERROR("plugin: Pinning thread `%s' to CPUs %s failed: %s", name, cg->desc,
+          STRERROR(status));
+  else
+    DEBUG("plugin: Pinned thread `%s' to CPUs %s.", name, cg->desc);
+#endif
+} /* }}} void thread_cpus_apply */
+
+#if HAVE_PTHREAD_SETAFFINITY_NP
+/* Moves the calling thread to the union of all groups in "cgl" and stores its
+ * previous affinity in "saved". Linux places a page on the NUMA node of the
+ * thread touching it first, so buffers initialized this way are local to the
+ * threads using them. Returns true if the affinity was changed. */
+static bool thread_cpus_enter(core_groups_list_t const *cgl, /* {{{ */
+                              cpu_set_t *saved) {
+  if (cgl->num_cgroups == 0)
+    return false;
+
+  if (pthread_getaffinity_np(pthread_self(), sizeof(*saved), saved) != 0)
+    return false;
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (size_t i = 0; i < cgl->num_cgroups; i++)
+    for (size_t j = 0; j < cgl->cgroups[i].num_cores; j++)
+      if (cgl->cgroups[i].cores[j] < CPU_SETSIZE)
+        CPU_SET(cgl->cgroups[i].cores[j], &set);
+
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+} /* }}} bool thread_cpus_enter */
+#endif
+
 static void start_read_threads(size_t num) /* {{{ */
 {
   if (read_threads != NULL)
     return;
 
+  read_scheds = calloc(num, sizeof(*read_scheds));
   read_threads = calloc(num, sizeof(*read_threads));
-  if (read_threads == NULL) {
+  if ((read_scheds == NULL) || (read_threads == NULL)) {
     ERROR("plugin: start_read_threads: calloc failed.");
+    sfree(read_scheds);
+    sfree(read_threads);
     return;
   }
 
   read_threads_num = 0;
   for (size_t i = 0; i < num; i++) {
-    int status = pthread_create(read_threads + read_threads_num,
+    read_sched_t *s = read_scheds + i;
+
+    s->heap = c_timeheap_create();
+    if (s->heap == NULL) {
+      ERROR("plugin: start_read_threads: c_timeheap_create failed.");
+      break;
+    }
+    pthread_mutex_init(&s->lock, /* attr = */ NULL);
+    pthread_cond_init(&s->cond, /* attr = */ NULL);
+
+    int status = pthread_create(read_threads + read_threads_num,
                                 /* attr = */ NULL, plugin_read_thread,
-                                /* arg = */ NULL);
+                                /* arg = */ (void *)(uintptr_t)i);
     if (status != 0) {
       ERROR("plugin: start_read_threads: pthread_create failed with status %i "
             "(%s).",
             status, STRERROR(status));
-      return;
+      pthread_cond_destroy(&s->cond);
+      pthread_mutex_destroy(&s->lock);
+      c_timeheap_destroy(s->heap);
+      s->heap = NULL;
+      break;
     }
 
     char name[THREAD_NAME_MAX];
     ssnprintf(name, sizeof(name), "reader#%" PRIu64,
               (uint64_t)read_threads_num);
     set_thread_name(read_threads[read_threads_num], name);
+    thread_cpus_apply(read_threads[read_threads_num], &read_thread_cpus, i,
+                      name);
 
     read_threads_num++;
   } /* for (i) */
+
+  if (read_threads_num == 0)
+    return;
+
+  /* Hand the registered read functions to the running threads. */
+  pthread_mutex_lock(&read_lock);
+  __atomic_store_n(&read_scheds_num, read_threads_num, __ATOMIC_RELEASE);
+  for (size_t i = 0;; i++) {
+    read_func_t *rf = c_timeheap_get_root(read_heap, NULL);
+    if (rf == NULL)
+      break;
+
+    rf->rf_next_read += read_spread_offset(rf);
+
+    read_sched_t *s = read_scheds + (i % read_threads_num);
+    if (rf->rf_read_group != NULL) {
+      if (rf->rf_read_group->sched == NULL)
+        rf->rf_read_group->sched = s;
+      s = rf->rf_read_group->sched;
+    }
+    pthread_mutex_lock(&s->lock);
+    if (read_sched_insert(s, rf) != 0)
+      ERROR("plugin: start_read_threads: c_timeheap_insert failed.");
+    pthread_mutex_unlock(&s->lock);
+  }
+  pthread_mutex_unlock(&read_lock);
 } /* }}} void start_read_threads */
 
 static void stop_read_threads(void) {
@@ -668,11 +1812,13 @@ static void stop_read_threads(void) {
 
   INFO("collectd: Stopping %" PRIsz " read threads.", read_threads_num);
 
-  pthread_mutex_lock(&read_lock);
   read_loop = 0;
-  DEBUG("plugin: stop_read_threads: Signalling `read_cond'");
-  pthread_cond_broadcast(&read_cond);
-  pthread_mutex_unlock(&read_lock);
+  DEBUG("plugin: stop_read_threads: Signalling the read threads");
+  for (size_t i = 0; i < read_threads_num; i++) {
+    pthread_mutex_lock(&read_scheds[i].lock);
+    pthread_cond_broadcast(&read_scheds[i].cond);
+    pthread_mutex_unlock(&read_scheds[i].lock);
+  }
 
   for (size_t i = 0; i < read_threads_num; i++) {
     if (pthread_join(read_threads[i], NULL) != 0) {
@@ -680,102 +1826,340 @@ static void stop_read_threads(void) {
     }
     read_threads[i] = (pthread_t)0;
   }
+
+  /* Move the read functions back to `read_heap', so destroy_read_heap() can
+   * free them. */
+  pthread_mutex_lock(&read_lock);
+  __atomic_store_n(&read_scheds_num, 0, __ATOMIC_RELEASE);
+  for (size_t i = 0; i < read_threads_num; i++) {
+    read_sched_t *s = read_scheds + i;
+    read_func_t *rf;
+
+    while ((rf = c_timeheap_get_root(s->heap, NULL)) != NULL)
+      c_timeheap_insert(read_heap, rf->rf_next_read, rf);
+
+    c_timeheap_destroy(s->heap);
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->lock);
+  }
+  for (size_t i = 0; i < read_groups_num; i++)
+    read_groups[i]->sched = NULL;
+  pthread_mutex_unlock(&read_lock);
+
+  sfree(read_scheds);
   sfree(read_threads);
   read_threads_num = 0;
 } /* void stop_read_threads */
 
-static void plugin_value_list_free(value_list_t *vl) /* {{{ */
+/* Returns the offset of the meta data copy in a queued_value_list_t. */
+static size_t queued_value_list_meta_offset(size_t values_len,
+                                            bool with_rates) {
+  size_t align = _Alignof(max_align_t);
+  size_t offset = sizeof(queued_value_list_t) + values_len * sizeof(value_t) +
+                  (with_rates ? values_len * sizeof(gauge_t) : 0);
+  return (offset + align - 1) / align * align;
+} /* size_t queued_value_list_meta_offset */
+
+static size_t queued_value_list_size(size_t values_len, bool with_rates,
+                                     bool with_meta) {
+  if (with_meta)
+    return queued_value_list_meta_offset(values_len, with_rates) +
+           meta_data_size();
+  return sizeof(queued_value_list_t) + values_len * sizeof(value_t) +
+         (with_rates ? values_len * sizeof(gauge_t) : 0);
+} /* size_t queued_value_list_size */
+
+static void queued_value_list_destroy(queued_value_list_t *qvl) /* {{{ */
 {
-  if (vl == NULL)
+  if (qvl == NULL)
     return;
 
-  meta_data_destroy(vl->meta);
-  sfree(vl->values);
-  sfree(vl);
-} /* }}} void plugin_value_list_free */
-
-static value_list_t *
-plugin_value_list_clone(value_list_t const *vl_orig) /* {{{ */
+  identifier_release(qvl->id);
+  /* Releases the copy in the block, or meta data added by a target to a value
+   * list which had none. */
+  meta_data_destroy(qvl->meta);
+  memstats_add(qvl->owner,
+               -(int64_t)queued_value_list_size(
+                   qvl->values_len, qvl->rates != NULL, qvl->with_meta),
+               -1);
+  sfree(qvl);
+} /* }}} void queued_value_list_destroy */
+
+/* Returns a copy of `vl' in the compact representation used by the write
+ * queues. The values, attached rates and meta data are stored in the same
+ * block, so a copy costs a single allocation. The meta data entries are
+ * shared with `vl' until either is modified. */
+static queued_value_list_t *
+queued_value_list_create(value_list_t const *vl) /* {{{ */
 {
-  value_list_t *vl;
-
-  if (vl_orig == NULL)
-    return NULL;
-
-  vl = malloc(sizeof(*vl));
   if (vl == NULL)
     return NULL;
-  memcpy(vl, vl_orig, sizeof(*vl));
 
-  if (vl->host[0] == 0)
-    sstrncpy(vl->host, hostname_g, sizeof(vl->host));
+  size_t size = queued_value_list_size(vl->values_len, vl->rates != NULL,
+                                       vl->meta != NULL);
+  queued_value_list_t *qvl = calloc(1, size);
+  if (qvl == NULL)
+    return NULL;
 
-  vl->values = calloc(vl_orig->values_len, sizeof(*vl->values));
-  if (vl->values == NULL) {
-    plugin_value_list_free(vl);
+  if (vl->host[0] == 0) {
+    value_list_t vl_copy = *vl;
+    sstrncpy(vl_copy.host, hostname_g, sizeof(vl_copy.host));
+    qvl->id = identifier_intern(&vl_copy);
+  } else {
+    qvl->id = identifier_intern(vl);
+  }
+  if (qvl->id == NULL) {
+    sfree(qvl);
     return NULL;
   }
-  memcpy(vl->values, vl_orig->values,
-         vl_orig->values_len * sizeof(*vl->values));
 
-  vl->meta = meta_data_clone(vl->meta);
-  if ((vl_orig->meta != NULL) && (vl->meta == NULL)) {
-    plugin_value_list_free(vl);
-    return NULL;
+  qvl->owner = memstats_owner_current();
+  memstats_add(qvl->owner, (int64_t)size, 1);
+
+  qvl->values_len = vl->values_len;
+  memcpy(qvl->values, vl->values, vl->values_len * sizeof(*qvl->values));
+  if (vl->rates != NULL) {
+    qvl->rates = (gauge_t *)(qvl->values + qvl->values_len);
+    memcpy(qvl->rates, vl->rates, vl->values_len * sizeof(*qvl->rates));
   }
 
-  if (vl->time == 0)
-    vl->time = cdtime();
+  if (vl->meta != NULL) {
+    qvl->with_meta = true;
+    qvl->meta = meta_data_clone_at(
+        (char *)qvl +
+            queued_value_list_meta_offset(qvl->values_len, qvl->rates != NULL),
+        vl->meta);
+  }
 
+  qvl->time = (vl->time != 0) ? vl->time : cdtime_cached();
   /* Fill in the interval from the thread context, if it is zero. */
-  if (vl->interval == 0)
-    vl->interval = plugin_get_interval();
+  qvl->interval = (vl->interval != 0) ? vl->interval : plugin_get_interval();
+
+  return qvl;
+} /* }}} queued_value_list_t *queued_value_list_create */
+
+/* Turns `qvl' back into a value list. `vl' points into `qvl', it must not be
+ * used after `qvl' has been destroyed. */
+static void queued_value_list_expand(queued_value_list_t *qvl, /* {{{ */
+                                     value_list_t *vl) {
+  *vl = (value_list_t){
+      .values = qvl->values,
+      .values_len = qvl->values_len,
+      .time = qvl->time,
+      .interval = qvl->interval,
+      .meta = qvl->meta,
+      .rates = qvl->rates,
+  };
+  identifier_to_vl(qvl->id, vl);
+} /* }}} void queued_value_list_expand */
+
+/* Returns the data set of `qvl'. The handle of the type is cached with the
+ * interned identifier, so the type is looked up by name only once per series
+ * rather than once per value. */
+static data_set_t const *queued_value_list_ds(queued_value_list_t *qvl,
+                                              char const *type) {
+  ds_handle_t handle = identifier_ds_handle(qvl->id);
+  data_set_t const *ds = plugin_get_ds_by_handle(handle);
+  if (ds != NULL)
+    return ds;
+
+  handle = plugin_get_ds_handle(type);
+  if (handle == DS_HANDLE_INVALID)
+    return NULL;
 
-  return vl;
-} /* }}} value_list_t *plugin_value_list_clone */
+  identifier_set_ds_handle(qvl->id, handle);
+  return plugin_get_ds_by_handle(handle);
+} /* data_set_t *queued_value_list_ds */
 
-static int plugin_write_enqueue(value_list_t const *vl) /* {{{ */
-{
-  write_queue_t *q;
+/* Returns the probability with which a value should be dropped, given the
+ * current length of a queue and its low and high water marks. */
+static double get_drop_probability(long length, long limit_low, /* {{{ */
+                                   long limit_high) {
+  long pos;
+  long size;
 
-  q = malloc(sizeof(*q));
-  if (q == NULL)
-    return ENOMEM;
-  q->next = NULL;
+  if (length < limit_low)
+    return 0.0;
+  if (length >= limit_high)
+    return 1.0;
 
-  q->vl = plugin_value_list_clone(vl);
-  if (q->vl == NULL) {
-    sfree(q);
-    return ENOMEM;
-  }
+  pos = 1 + length - limit_low;
+  size = 1 + limit_high - limit_low;
+
+  return (double)pos / (double)size;
+} /* }}} double get_drop_probability */
 
+/* Appends `qvls[0..num)' to the in-memory write queue, taking the lock of the
+ * list queue only once. `ds' is the data set of all value lists, or NULL if it
+ * has not been looked up. Takes ownership of the value lists, even on
+ * failure. */
+static int plugin_write_queue_qvls(queued_value_list_t **qvls, /* {{{ */
+                                   size_t num, data_set_t const *ds) {
   /* Store context of caller (read plugin); otherwise, it would not be
    * available to the write plugins when actually dispatching the
    * value-list later on. */
-  q->ctx = plugin_get_ctx();
+  plugin_ctx_t ctx = plugin_get_ctx();
+  cdtime_t dispatched =
+      (record_statistics || (write_latency_limit > 0)) ? cdtime() : 0;
+
+  if (write_ring != NULL) {
+    for (size_t i = 0; i < num; i++) {
+      write_queue_t e = {
+          .qvl = qvls[i],
+          .ds = ds,
+          .ctx = ctx,
+          .dispatched = dispatched,
+      };
+      CD_PROBE1(write_enqueue, qvls[i]);
+
+      /* Blocks while the ring is full. */
+      int status = c_ring_push_wait(write_ring, &e);
+      if (status != 0) {
+        for (; i < num; i++)
+          queued_value_list_destroy(qvls[i]);
+        return status;
+      }
+    }
+    return 0;
+  }
+
+  write_queue_t *head = NULL;
+  write_queue_t *tail = NULL;
+  for (size_t i = 0; i < num; i++) {
+    write_queue_t *q = malloc(sizeof(*q));
+    if (q == NULL) {
+      for (size_t j = i; j < num; j++)
+        queued_value_list_destroy(qvls[j]);
+      while (head != NULL) {
+        q = head;
+        head = q->next;
+        queued_value_list_destroy(q->qvl);
+        sfree(q);
+      }
+      return ENOMEM;
+    }
+    *q = (write_queue_t){
+        .qvl = qvls[i],
+        .ds = ds,
+        .ctx = ctx,
+        .dispatched = dispatched,
+    };
+    CD_PROBE1(write_enqueue, qvls[i]);
+
+    if (tail == NULL)
+      head = q;
+    else
+      tail->next = q;
+    tail = q;
+  }
+
+  if (head == NULL)
+    return 0;
 
   pthread_mutex_lock(&write_lock);
 
   if (write_queue_tail == NULL) {
-    write_queue_head = q;
-    write_queue_tail = q;
-    write_queue_length = 1;
+    write_queue_head = head;
+    write_queue_length = (long)num;
   } else {
-    write_queue_tail->next = q;
-    write_queue_tail = q;
-    write_queue_length += 1;
+    write_queue_tail->next = head;
+    write_queue_length += (long)num;
   }
+  write_queue_tail = tail;
 
-  pthread_cond_signal(&write_cond);
+  if (num == 1)
+    pthread_cond_signal(&write_cond);
+  else
+    pthread_cond_broadcast(&write_cond);
   pthread_mutex_unlock(&write_lock);
 
   return 0;
+} /* }}} int plugin_write_queue_qvls */
+
+/* Appends `qvl' to the disk spool and destroys it. */
+static int plugin_write_spill_qvl(queued_value_list_t *qvl) /* {{{ */
+{
+  value_list_t vl;
+  queued_value_list_expand(qvl, &vl);
+
+  void *buf = NULL;
+  size_t len = 0;
+  int status = write_spool_encode(&vl, &buf, &len);
+  if (status == 0) {
+    pthread_mutex_lock(&write_spool_lock);
+    __atomic_store_n(&write_spool_active, true, __ATOMIC_RELEASE);
+    status = c_spool_append(write_spool, buf, len);
+    pthread_mutex_unlock(&write_spool_lock);
+    sfree(buf);
+  }
+  queued_value_list_destroy(qvl);
+
+  if (status != 0) {
+    c_complain(LOG_ERR, &write_spool_complaint,
+               "plugin: Appending to the write queue spool failed: %s",
+               STRERROR(status));
+    if (record_statistics) {
+      pthread_mutex_lock(&statistics_lock);
+      stats_values_dropped++;
+      pthread_mutex_unlock(&statistics_lock);
+    }
+    return status;
+  }
+
+  c_release(LOG_INFO, &write_spool_complaint,
+            "plugin: Appending to the write queue spool succeeded again.");
+  if (record_statistics)
+    __atomic_fetch_add(&stats_values_spooled, 1, __ATOMIC_RELAXED);
+  return 0;
+} /* }}} int plugin_write_spill_qvl */
+
+/* Queues `qvls[0..num)' for the write threads, see plugin_write_queue_qvls().
+ * Value lists go to the disk spool instead while the queue is too long or the
+ * spool still holds older value lists. */
+static int plugin_write_enqueue_qvls(queued_value_list_t **qvls, /* {{{ */
+                                     size_t num, data_set_t const *ds) {
+  write_enqueued += num;
+
+  if ((write_spool == NULL) ||
+      (!__atomic_load_n(&write_spool_active, __ATOMIC_ACQUIRE) &&
+       (plugin_write_queue_length() < write_spool_high)))
+    return plugin_write_queue_qvls(qvls, num, ds);
+
+  int ret = 0;
+  for (size_t i = 0; i < num; i++) {
+    int status = plugin_write_spill_qvl(qvls[i]);
+    if (status != 0)
+      ret = status;
+  }
+  return ret;
+} /* }}} int plugin_write_enqueue_qvls */
+
+static int plugin_write_enqueue(value_list_t const *vl) /* {{{ */
+{
+  queued_value_list_t *qvl = queued_value_list_create(vl);
+  if (qvl == NULL)
+    return ENOMEM;
+
+  return plugin_write_enqueue_qvls(&qvl, 1, /* ds = */ NULL);
 } /* }}} int plugin_write_enqueue */
 
-static value_list_t *plugin_write_dequeue(void) /* {{{ */
+static queued_value_list_t *
+plugin_write_dequeue(data_set_t const **ds, cdtime_t *dispatched) /* {{{ */
 {
   write_queue_t *q;
-  value_list_t *vl;
+  queued_value_list_t *qvl;
+
+  if (write_ring != NULL) {
+    write_queue_t e;
+
+    if (c_ring_pop_wait(write_ring, &e) != 0)
+      return NULL;
+
+    (void)plugin_set_ctx(e.ctx);
+    *ds = e.ds;
+    *dispatched = e.dispatched;
+    return e.qvl;
+  }
 
   pthread_mutex_lock(&write_lock);
 
@@ -799,27 +2183,179 @@ static value_list_t *plugin_write_dequeue(void) /* {{{ */
 
   (void)plugin_set_ctx(q->ctx);
 
-  vl = q->vl;
+  qvl = q->qvl;
+  *ds = q->ds;
+  *dispatched = q->dispatched;
   sfree(q);
-  return vl;
-} /* }}} value_list_t *plugin_write_dequeue */
+  return qvl;
+} /* }}} queued_value_list_t *plugin_write_dequeue */
 
 static void *plugin_write_thread(void __attribute__((unused)) * args) /* {{{ */
 {
   while (write_loop) {
-    value_list_t *vl = plugin_write_dequeue();
-    if (vl == NULL)
+    data_set_t const *ds = NULL;
+    queued_value_list_t *qvl = plugin_write_dequeue(&ds, &write_dispatched);
+    if (qvl == NULL)
       continue;
 
-    plugin_dispatch_values_internal(vl);
+    value_list_t vl;
+    queued_value_list_expand(qvl, &vl);
+    CD_PROBE3(write_dequeue, qvl, vl.plugin, vl.type);
+    if (ds == NULL)
+      ds = queued_value_list_ds(qvl, vl.type);
+
+    if (write_dispatched != 0) {
+      cdtime_t now = cdtime();
+      __atomic_store_n(&write_latency,
+                       (now > write_dispatched) ? now - write_dispatched : 0,
+                       __ATOMIC_RELAXED);
+    }
+
+    plugin_dispatch_values_internal(&vl, ds);
+    write_dispatched = 0;
 
-    plugin_value_list_free(vl);
+    /* Targets may have replaced the meta data. */
+    qvl->meta = vl.meta;
+    queued_value_list_destroy(qvl);
   }
 
   pthread_exit(NULL);
   return (void *)0;
 } /* }}} void *plugin_write_thread */
 
+/* Waits until `deadline' or until the replay thread is asked to stop. */
+static void write_spool_wait(cdtime_t deadline) /* {{{ */
+{
+  pthread_mutex_lock(&write_spool_lock);
+  if (write_spool_loop)
+    pthread_cond_timedwait(&write_spool_cond, &write_spool_lock,
+                           &CDTIME_T_TO_TIMESPEC(deadline));
+  pthread_mutex_unlock(&write_spool_lock);
+} /* }}} void write_spool_wait */
+
+/* Moves the oldest value list of the spool to the write queue. Returns ENOENT
+ * once the spool is empty. */
+static int write_spool_replay_one(void) /* {{{ */
+{
+  void *buf = NULL;
+  size_t len = 0;
+  c_spool_pos_t pos;
+
+  int status = c_spool_peek(write_spool, &buf, &len, &pos);
+  if (status == ENOENT) {
+    pthread_mutex_lock(&write_spool_lock);
+    if (c_spool_records(write_spool) == 0)
+      __atomic_store_n(&write_spool_active, false, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&write_spool_lock);
+    return ENOENT;
+  } else if (status != 0) {
+    return status;
+  }
+
+  value_list_t vl;
+  status = write_spool_decode(buf, len, &vl);
+  sfree(buf);
+  if (status != 0) {
+    ERROR("plugin: Discarding a broken record of the write queue spool.");
+    c_spool_consume(write_spool, pos);
+    return 0;
+  }
+
+  queued_value_list_t *qvl = queued_value_list_create(&vl);
+  write_spool_free(&vl);
+  if (qvl == NULL)
+    return ENOMEM;
+
+  /* The value list is only consumed once it is queued. If the daemon dies in
+   * between, it is written twice rather than not at all. */
+  status = plugin_write_queue_qvls(&qvl, 1, /* ds = */ NULL);
+  if (status == 0)
+    c_spool_consume(write_spool, pos);
+  return status;
+} /* }}} int write_spool_replay_one */
+
+/* Replays spooled value lists to the write queue, at most
+ * "WriteQueueSpoolReplayRate" per second, and flushes the spool to disk once
+ * per second. */
+static void *plugin_write_spool_thread(void __attribute__((unused)) *
+                                       args) /* {{{ */
+{
+  cdtime_t const sync_interval = TIME_T_TO_CDTIME_T(1);
+  cdtime_t const step =
+      (write_spool_rate > 0.0) ? DOUBLE_TO_CDTIME_T(1.0 / write_spool_rate) : 0;
+  cdtime_t next_sync = cdtime() + sync_interval;
+  cdtime_t next_replay = 0;
+
+  while (__atomic_load_n(&write_spool_loop, __ATOMIC_ACQUIRE)) {
+    cdtime_t now = cdtime();
+    if (now >= next_sync) {
+      c_spool_sync(write_spool);
+      next_sync = now + sync_interval;
+    }
+
+    if (!__atomic_load_n(&write_spool_active, __ATOMIC_ACQUIRE) ||
+        (plugin_write_queue_length() >= write_spool_low)) {
+      write_spool_wait(now + MS_TO_CDTIME_T(10));
+      continue;
+    }
+
+    if (now < next_replay) {
+      write_spool_wait(next_replay);
+      continue;
+    }
+
+    int status = write_spool_replay_one();
+    if (status == ENOENT) {
+      continue;
+    } else if (status != 0) {
+      ERROR("plugin: Replaying the write queue spool failed: %s",
+            STRERROR(status));
+      write_spool_wait(now + sync_interval);
+      continue;
+    }
+
+    /* Don't save up for a burst while there was nothing to replay. */
+    if (step > 0)
+      next_replay = ((next_replay + sync_interval < now) ? now : next_replay) +
+                    step;
+  }
+
+  c_spool_sync(write_spool);
+  pthread_exit(NULL);
+  return (void *)0;
+} /* }}} void *plugin_write_spool_thread */
+
+static void start_write_spool_thread(void) /* {{{ */
+{
+  if ((write_spool == NULL) || write_spool_thread_running)
+    return;
+
+  write_spool_loop = true;
+  int status = pthread_create(&write_spool_thread, /* attr = */ NULL,
+                              plugin_write_spool_thread, /* arg = */ NULL);
+  if (status != 0) {
+    ERROR("plugin: start_write_spool_thread: pthread_create failed: %s",
+          STRERROR(status));
+    return;
+  }
+  set_thread_name(write_spool_thread, "writer#spool");
+  write_spool_thread_running = true;
+} /* }}} void start_write_spool_thread */
+
+static void stop_write_spool_thread(void) /* {{{ */
+{
+  if (!write_spool_thread_running)
+    return;
+
+  pthread_mutex_lock(&write_spool_lock);
+  __atomic_store_n(&write_spool_loop, false, __ATOMIC_RELEASE);
+  pthread_cond_broadcast(&write_spool_cond);
+  pthread_mutex_unlock(&write_spool_lock);
+
+  pthread_join(write_spool_thread, NULL);
+  write_spool_thread_running = false;
+} /* }}} void stop_write_spool_thread */
+
 static void start_write_threads(size_t num) /* {{{ */
 {
   if (write_threads != NULL)
@@ -847,6 +2383,8 @@ static void start_write_threads(size_t num) /* {{{ */
     ssnprintf(name, sizeof(name), "writer#%" PRIu64,
               (uint64_t)write_threads_num);
     set_thread_name(write_threads[write_threads_num], name);
+    thread_cpus_apply(write_threads[write_threads_num], &write_thread_cpus,
+                      write_thread_cpus_next++, name);
 
     write_threads_num++;
   } /* for (i) */
@@ -868,6 +2406,9 @@ static void stop_write_threads(void) /* {{{ */
   pthread_cond_broadcast(&write_cond);
   pthread_mutex_unlock(&write_lock);
 
+  if (write_ring != NULL)
+    c_ring_close(write_ring);
+
   for (i = 0; i < write_threads_num; i++) {
     if (pthread_join(write_threads[i], NULL) != 0) {
       ERROR("plugin: stop_write_threads: pthread_join failed.");
@@ -877,11 +2418,18 @@ static void stop_write_threads(void) /* {{{ */
   sfree(write_threads);
   write_threads_num = 0;
 
+  /* With a spool, the value lists left are written to it, to be replayed
+   * after the next start. They are appended after the spooled ones, so their
+   * order is not preserved. */
   pthread_mutex_lock(&write_lock);
   i = 0;
+  size_t spooled = 0;
   for (q = write_queue_head; q != NULL;) {
     write_queue_t *q1 = q;
-    plugin_value_list_free(q->vl);
+    if ((write_spool != NULL) && (plugin_write_spill_qvl(q->qvl) == 0))
+      spooled++;
+    else if (write_spool == NULL)
+      queued_value_list_destroy(q->qvl);
     q = q->next;
     sfree(q1);
     i++;
@@ -891,6 +2439,25 @@ static void stop_write_threads(void) /* {{{ */
   write_queue_length = 0;
   pthread_mutex_unlock(&write_lock);
 
+  /* The ring is closed but not destroyed: other threads may still be
+   * dispatching values and will fail gracefully. */
+  if (write_ring != NULL) {
+    write_queue_t e;
+    while (c_ring_pop(write_ring, &e) == 0) {
+      if ((write_spool != NULL) && (plugin_write_spill_qvl(e.qvl) == 0))
+        spooled++;
+      else if (write_spool == NULL)
+        queued_value_list_destroy(e.qvl);
+      i++;
+    }
+  }
+
+  if (spooled > 0) {
+    INFO("plugin: %" PRIsz " value list%s left after shutting down the write "
+         "threads %s been written to the spool.",
+         spooled, (spooled == 1) ? "" : "s", (spooled == 1) ? "has" : "have");
+    i -= spooled;
+  }
   if (i > 0) {
     WARNING("plugin: %" PRIsz " value list%s left after shutting down "
             "the write threads.",
@@ -899,93 +2466,912 @@ static void stop_write_threads(void) /* {{{ */
 } /* }}} void stop_write_threads */
 
 /*
- * Public functions
+ * Post-cache filter threads
+ *
+ * If "FilterThreads" is set, the write threads only run the pre-cache chain
+ * and update the cache. The post-cache chain is run by the filter threads.
+ * Value lists are assigned to a filter thread by the hash of their
+ * identifier, so all values of one series are processed by the same thread,
+ * in the order in which they passed the cache.
  */
-void plugin_set_dir(const char *dir) {
-  sfree(plugindir);
+static int plugin_filter_enqueue(data_set_t const *ds, /* {{{ */
+                                 value_list_t const *vl) {
+  write_queue_t *q = calloc(1, sizeof(*q));
+  if (q == NULL)
+    return ENOMEM;
 
-  if (dir == NULL) {
-    plugindir = NULL;
-    return;
+  q->qvl = queued_value_list_create(vl);
+  if (q->qvl == NULL) {
+    sfree(q);
+    return ENOMEM;
   }
+  q->ds = ds;
+  q->ctx = plugin_get_ctx();
+  q->dispatched = write_dispatched;
 
-  plugindir = strdup(dir);
-  if (plugindir == NULL)
-    ERROR("plugin_set_dir: strdup(\"%s\") failed", dir);
-}
+  filter_shard_t *s =
+      filter_shards + (identifier_hash(q->qvl->id) % filter_shards_num);
 
-bool plugin_is_loaded(char const *name) {
-  if (plugins_loaded == NULL)
-    plugins_loaded =
-        c_avl_create((int (*)(const void *, const void *))strcasecmp);
-  assert(plugins_loaded != NULL);
+  pthread_mutex_lock(&s->lock);
+  if (s->tail == NULL)
+    s->head = q;
+  else
+    s->tail->next = q;
+  s->tail = q;
+  __atomic_add_fetch(&filter_queue_length, 1, __ATOMIC_RELAXED);
+  pthread_cond_signal(&s->cond);
+  pthread_mutex_unlock(&s->lock);
 
-  int status = c_avl_get(plugins_loaded, name, /* ret_value = */ NULL);
-  return status == 0;
-}
+  return 0;
+} /* }}} int plugin_filter_enqueue */
 
-static int plugin_mark_loaded(char const *name) {
-  char *name_copy;
-  int status;
+static void *plugin_filter_thread(void *args) /* {{{ */
+{
+  filter_shard_t *s = args;
+
+  while (true) {
+    /* Take all queued value lists at once. */
+    pthread_mutex_lock(&s->lock);
+    while (filter_loop && (s->head == NULL))
+      pthread_cond_wait(&s->cond, &s->lock);
+    write_queue_t *batch = s->head;
+    s->head = NULL;
+    s->tail = NULL;
+    pthread_mutex_unlock(&s->lock);
+
+    /* Only happens while shutting down, after the queue has been drained. */
+    if (batch == NULL)
+      break;
 
-  name_copy = strdup(name);
-  if (name_copy == NULL)
-    return ENOMEM;
+    while (batch != NULL) {
+      write_queue_t *q = batch;
+      batch = q->next;
 
-  status = c_avl_insert(plugins_loaded,
-                        /* key = */ name_copy, /* value = */ NULL);
-  return status;
-}
+      value_list_t vl;
+      queued_value_list_expand(q->qvl, &vl);
 
-static void plugin_free_loaded(void) {
-  void *key;
-  void *value;
+      (void)plugin_set_ctx(q->ctx);
+      write_dispatched = q->dispatched;
+      plugin_dispatch_post_cache(q->ds, &vl);
+      write_dispatched = 0;
 
-  if (plugins_loaded == NULL)
+      /* Targets may have replaced the meta data. */
+      q->qvl->meta = vl.meta;
+      queued_value_list_destroy(q->qvl);
+      sfree(q);
+      __atomic_sub_fetch(&filter_queue_length, 1, __ATOMIC_RELAXED);
+    }
+  }
+
+  pthread_exit(NULL);
+  return (void *)0;
+} /* }}} void *plugin_filter_thread */
+
+static void start_filter_threads(size_t num) /* {{{ */
+{
+  if ((filter_shards != NULL) || (num == 0))
     return;
 
-  while (c_avl_pick(plugins_loaded, &key, &value) == 0) {
-    sfree(key);
-    assert(value == NULL);
+  filter_shards = calloc(num, sizeof(*filter_shards));
+  if (filter_shards == NULL) {
+    ERROR("plugin: start_filter_threads: calloc failed.");
+    return;
   }
 
-  c_avl_destroy(plugins_loaded);
-  plugins_loaded = NULL;
-}
+  filter_loop = true;
+  for (size_t i = 0; i < num; i++) {
+    filter_shard_t *s = filter_shards + i;
 
-#define BUFSIZE 512
-#ifdef WIN32
-#define SHLIB_SUFFIX ".dll"
-#else
-#define SHLIB_SUFFIX ".so"
-#endif
-int plugin_load(char const *plugin_name, bool global) {
-  DIR *dh;
-  const char *dir;
-  char filename[BUFSIZE] = "";
-  char typename[BUFSIZE];
-  int ret;
-  struct stat statbuf;
-  struct dirent *de;
-  int status;
+    pthread_mutex_init(&s->lock, /* attr = */ NULL);
+    pthread_cond_init(&s->cond, /* attr = */ NULL);
 
-  if (plugin_name == NULL)
-    return EINVAL;
+    int status = pthread_create(&s->thread, /* attr = */ NULL,
+                                plugin_filter_thread, /* arg = */ s);
+    if (status != 0) {
+      ERROR("plugin: start_filter_threads: pthread_create failed with status "
+            "%i (%s).",
+            status, STRERROR(status));
+      pthread_cond_destroy(&s->cond);
+      pthread_mutex_destroy(&s->lock);
+      break;
+    }
 
-  /* Check if plugin is already loaded and don't do anything in this
-   * case. */
-  if (plugin_is_loaded(plugin_name))
-    return 0;
+    char name[THREAD_NAME_MAX];
+    ssnprintf(name, sizeof(name), "filter#%" PRIu64, (uint64_t)i);
+    set_thread_name(s->thread, name);
+    thread_cpus_apply(s->thread, &write_thread_cpus, write_thread_cpus_next++,
+                      name);
 
-  dir = plugin_get_dir();
-  ret = 1;
+    filter_shards_num++;
+  }
 
-  /*
-   * XXX: Magic at work:
-   *
-   * Some of the language bindings, for example the Python and Perl
-   * plugins, need to be able to export symbols to the scripts they run.
-   * For this to happen, the "Globals" flag needs to be set.
+  if (filter_shards_num == 0)
+    sfree(filter_shards);
+} /* }}} void start_filter_threads */
+
+/* Must be called after stop_write_threads(), so no more value lists are
+ * enqueued. The filter threads process all queued value lists before they
+ * exit. */
+static void stop_filter_threads(void) /* {{{ */
+{
+  if (filter_shards == NULL)
+    return;
+
+  INFO("collectd: Stopping %" PRIsz " filter threads.", filter_shards_num);
+
+  for (size_t i = 0; i < filter_shards_num; i++) {
+    pthread_mutex_lock(&filter_shards[i].lock);
+    filter_loop = false;
+    pthread_cond_broadcast(&filter_shards[i].cond);
+    pthread_mutex_unlock(&filter_shards[i].lock);
+  }
+
+  for (size_t i = 0; i < filter_shards_num; i++) {
+    filter_shard_t *s = filter_shards + i;
+
+    if (pthread_join(s->thread, NULL) != 0)
+      ERROR("plugin: stop_filter_threads: pthread_join failed.");
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->lock);
+  }
+
+  sfree(filter_shards);
+  filter_shards_num = 0;
+} /* }}} void stop_filter_threads */
+
+/*
+ * Notification threads
+ *
+ * If "NotificationThreads" is positive, plugin_dispatch_notification() only
+ * copies the notification into the notification queue and the notification
+ * callbacks are run by these threads.
+ */
+static void plugin_notification_run_callbacks(notification_t const *n) /* {{{ */
+{
+  for (llentry_t *le = llist_head(list_notification); le != NULL;
+       le = le->next) {
+    /* do not switch plugin context; rather keep the context
+     * (interval) information of the calling plugin */
+    callback_func_t *cf = le->value;
+    plugin_notification_cb callback = cf->cf_callback;
+    int status = (*callback)(n, &cf->cf_udata);
+    if (status != 0) {
+      WARNING("plugin_dispatch_notification: Notification "
+              "callback %s returned %i.",
+              le->key, status);
+    }
+  }
+} /* }}} void plugin_notification_run_callbacks */
+
+static queued_notification_t *
+queued_notification_create(notification_t const *n) /* {{{ */
+{
+  size_t meta_num = 0;
+  size_t strings_size = 0;
+  for (notification_meta_t const *m = n->meta; m != NULL; m = m->next) {
+    meta_num++;
+    if ((m->type == NM_TYPE_STRING) && (m->nm_value.nm_string != NULL))
+      strings_size += strlen(m->nm_value.nm_string) + 1;
+  }
+
+  queued_notification_t *qn = malloc(
+      sizeof(*qn) + meta_num * sizeof(qn->meta[0]) + strings_size);
+  if (qn == NULL)
+    return NULL;
+  *qn = (queued_notification_t){
+      .n = *n,
+      .ctx = plugin_get_ctx(),
+  };
+  qn->n.meta = (meta_num > 0) ? qn->meta : NULL;
+
+  char *strings = (char *)(qn->meta + meta_num);
+  size_t i = 0;
+  for (notification_meta_t const *m = n->meta; m != NULL; m = m->next, i++) {
+    qn->meta[i] = *m;
+    qn->meta[i].next = (i + 1 < meta_num) ? qn->meta + i + 1 : NULL;
+
+    if ((m->type == NM_TYPE_STRING) && (m->nm_value.nm_string != NULL)) {
+      size_t len = strlen(m->nm_value.nm_string) + 1;
+      memcpy(strings, m->nm_value.nm_string, len);
+      qn->meta[i].nm_value.nm_string = strings;
+      strings += len;
+    }
+  }
+
+  return qn;
+} /* }}} queued_notification_t *queued_notification_create */
+
+static void queued_notification_destroy(queued_notification_t *qn) /* {{{ */
+{
+  if (qn == NULL)
+    return;
+
+  sfree(qn->key);
+  sfree(qn);
+} /* }}} void queued_notification_destroy */
+
+/* Must be called with "notif_lock" held. */
+static void plugin_notification_unlink(queued_notification_t *qn) /* {{{ */
+{
+  if (qn->prev != NULL)
+    qn->prev->next = qn->next;
+  else
+    notif_queue_head = qn->next;
+
+  if (qn->next != NULL)
+    qn->next->prev = qn->prev;
+  else
+    notif_queue_tail = qn->prev;
+
+  qn->prev = NULL;
+  qn->next = NULL;
+  notif_queue_length--;
+
+  if (qn->key != NULL)
+    c_avl_remove(notif_pending, qn->key, NULL, NULL);
+} /* }}} void plugin_notification_unlink */
+
+static int plugin_notification_enqueue(notification_t const *n) /* {{{ */
+{
+  queued_notification_t *qn = queued_notification_create(n);
+  if (qn == NULL) {
+    ERROR("plugin_dispatch_notification: malloc failed.");
+    return ENOMEM;
+  }
+
+  if ((notif_pending != NULL) && (n->type[0] != 0)) {
+    char key[6 * DATA_MAX_NAME_LEN];
+    format_name(key, sizeof(key), n->host, n->plugin, n->plugin_instance,
+                n->type, n->type_instance);
+    qn->key = strdup(key);
+  }
+
+  pthread_mutex_lock(&notif_lock);
+
+  /* The threads are shutting down, let the caller deliver the notification. */
+  if (!notif_loop) {
+    pthread_mutex_unlock(&notif_lock);
+    queued_notification_destroy(qn);
+    return EAGAIN;
+  }
+
+  /* Replace an older notification for the same identifier which is still
+   * waiting in the queue. */
+  queued_notification_t *old = NULL;
+  if ((qn->key != NULL) &&
+      (c_avl_get(notif_pending, qn->key, (void *)&old) == 0)) {
+    qn->prev = old->prev;
+    qn->next = old->next;
+    if (qn->prev != NULL)
+      qn->prev->next = qn;
+    else
+      notif_queue_head = qn;
+    if (qn->next != NULL)
+      qn->next->prev = qn;
+    else
+      notif_queue_tail = qn;
+
+    c_avl_remove(notif_pending, old->key, NULL, NULL);
+    c_avl_insert(notif_pending, qn->key, qn);
+    stats_notifications_coalesced++;
+    pthread_mutex_unlock(&notif_lock);
+
+    queued_notification_destroy(old);
+    return 0;
+  }
+
+  if ((notif_queue_limit > 0) && (notif_queue_length >= notif_queue_limit)) {
+    stats_notifications_dropped++;
+    pthread_mutex_unlock(&notif_lock);
+
+    c_complain(LOG_WARNING, &notif_queue_complaint,
+               "plugin_dispatch_notification: The notification queue is "
+               "full (NotificationQueueLimit %ld). Dropping notifications.",
+               notif_queue_limit);
+    queued_notification_destroy(qn);
+    return ENOBUFS;
+  }
+  c_release(LOG_INFO, &notif_queue_complaint,
+            "plugin_dispatch_notification: Notifications are queued again.");
+
+  if ((qn->key != NULL) && (c_avl_insert(notif_pending, qn->key, qn) != 0))
+    sfree(qn->key);
+
+  qn->prev = notif_queue_tail;
+  if (notif_queue_tail != NULL)
+    notif_queue_tail->next = qn;
+  else
+    notif_queue_head = qn;
+  notif_queue_tail = qn;
+  notif_queue_length++;
+
+  pthread_cond_signal(&notif_cond);
+  pthread_mutex_unlock(&notif_lock);
+
+  return 0;
+} /* }}} int plugin_notification_enqueue */
+
+static void *plugin_notification_thread(void __attribute__((unused)) *
+                                        args) /* {{{ */
+{
+  pthread_mutex_lock(&notif_lock);
+  while (42) {
+    while (notif_loop && (notif_queue_head == NULL))
+      pthread_cond_wait(&notif_cond, &notif_lock);
+
+    /* The queue is drained before the threads exit. */
+    queued_notification_t *qn = notif_queue_head;
+    if (qn == NULL)
+      break;
+    plugin_notification_unlink(qn);
+    pthread_mutex_unlock(&notif_lock);
+
+    (void)plugin_set_ctx(qn->ctx);
+    plugin_notification_run_callbacks(&qn->n);
+    queued_notification_destroy(qn);
+
+    pthread_mutex_lock(&notif_lock);
+  }
+  pthread_mutex_unlock(&notif_lock);
+
+  return NULL;
+} /* }}} void *plugin_notification_thread */
+
+static void start_notification_threads(size_t num) /* {{{ */
+{
+  if ((notif_threads != NULL) || (num == 0))
+    return;
+
+  notif_threads = calloc(num, sizeof(*notif_threads));
+  if (notif_threads == NULL) {
+    ERROR("plugin: start_notification_threads: calloc failed.");
+    return;
+  }
+
+  pthread_mutex_lock(&notif_lock);
+  notif_loop = true;
+  pthread_mutex_unlock(&notif_lock);
+
+  notif_threads_num = 0;
+  for (size_t i = 0; i < num; i++) {
+    int status = pthread_create(notif_threads + notif_threads_num,
+                                /* attr = */ NULL, plugin_notification_thread,
+                                /* arg = */ NULL);
+    if (status != 0) {
+      ERROR("plugin: start_notification_threads: pthread_create failed "
+            "with status %i (%s).",
+            status, STRERROR(status));
+      break;
+    }
+
+    char name[THREAD_NAME_MAX];
+    ssnprintf(name, sizeof(name), "notif#%" PRIu64,
+              (uint64_t)notif_threads_num);
+    set_thread_name(notif_threads[notif_threads_num], name);
+
+    notif_threads_num++;
+  }
+
+  if (notif_threads_num == 0)
+    sfree(notif_threads);
+} /* }}} void start_notification_threads */
+
+/* Delivers the remaining notifications and stops the threads. Notifications
+ * dispatched afterwards are delivered synchronously again. */
+static void stop_notification_threads(void) /* {{{ */
+{
+  if (notif_threads == NULL)
+    return;
+
+  INFO("collectd: Stopping %" PRIsz " notification threads.",
+       notif_threads_num);
+
+  pthread_mutex_lock(&notif_lock);
+  notif_loop = false;
+  pthread_cond_broadcast(&notif_cond);
+  pthread_mutex_unlock(&notif_lock);
+
+  for (size_t i = 0; i < notif_threads_num; i++) {
+    if (pthread_join(notif_threads[i], NULL) != 0)
+      ERROR("plugin: stop_notification_threads: pthread_join failed.");
+  }
+
+  pthread_mutex_lock(&notif_lock);
+  sfree(notif_threads);
+  notif_threads_num = 0;
+  if (notif_pending != NULL) {
+    c_avl_destroy(notif_pending);
+    notif_pending = NULL;
+  }
+  pthread_mutex_unlock(&notif_lock);
+} /* }}} void stop_notification_threads */
+
+/*
+ * Private write queues of individual write plugins
+ */
+static void *plugin_writer_thread(void *args) /* {{{ */
+{
+  write_func_t *wf = args;
+
+  while (42) {
+    write_queue_t *q;
+
+    pthread_mutex_lock(&wf->wf_lock);
+    while (wf->wf_loop && (wf->wf_queue_head == NULL))
+      pthread_cond_wait(&wf->wf_cond, &wf->wf_lock);
+
+    if (!wf->wf_loop) {
+      pthread_mutex_unlock(&wf->wf_lock);
+      break;
+    }
+
+    q = wf->wf_queue_head;
+    wf->wf_queue_head = q->next;
+    wf->wf_queue_length -= 1;
+    if (wf->wf_queue_head == NULL) {
+      wf->wf_queue_tail = NULL;
+      assert(0 == wf->wf_queue_length);
+    }
+
+    if (wf->wf_block)
+      pthread_cond_signal(&wf->wf_cond_free);
+    pthread_mutex_unlock(&wf->wf_lock);
+
+    (void)plugin_set_ctx(q->ctx);
+
+    value_list_t vl;
+    queued_value_list_expand(q->qvl, &vl);
+
+    callback_stats_mark_t mark;
+    callback_stats_begin(wf->wf_stats, &mark);
+    callback_stats_age(wf->wf_stats, &mark, q->dispatched);
+    plugin_write_cb callback = wf->wf_callback;
+    (*callback)(q->ds, &vl, &wf->wf_udata);
+    callback_stats_end(wf->wf_stats, &mark);
+
+    queued_value_list_destroy(q->qvl);
+    sfree(q);
+  }
+
+  pthread_exit(NULL);
+  return (void *)0;
+} /* }}} void *plugin_writer_thread */
+
+/* Like plugin_writer_thread(), but for writers registered with
+ * plugin_register_write_batch(): waits until `wf_batch_size' value lists have
+ * been queued or the oldest one has been waiting for `wf_batch_max_age', and
+ * passes them to the callback in one go. The queue is drained before the
+ * thread exits, because batch writers rely on the daemon for buffering. */
+static void *plugin_writer_batch_thread(void *args) /* {{{ */
+{
+  write_func_t *wf = args;
+  size_t batch_size = wf->wf_batch_size;
+
+  write_queue_t **queued = calloc(batch_size, sizeof(*queued));
+  value_list_t *vls = calloc(batch_size, sizeof(*vls));
+  write_batch_entry_t *entries = calloc(batch_size, sizeof(*entries));
+  if ((queued == NULL) || (vls == NULL) || (entries == NULL)) {
+    ERROR("plugin: plugin_writer_batch_thread: calloc failed.");
+    sfree(queued);
+    sfree(vls);
+    sfree(entries);
+    pthread_exit(NULL);
+    return (void *)0;
+  }
+
+  while (42) {
+    size_t num = 0;
+
+    pthread_mutex_lock(&wf->wf_lock);
+    while (wf->wf_loop && (wf->wf_queue_head == NULL))
+      pthread_cond_wait(&wf->wf_cond, &wf->wf_lock);
+
+    if (wf->wf_queue_head == NULL) {
+      /* Only reached when shutting down. */
+      pthread_mutex_unlock(&wf->wf_lock);
+      break;
+    }
+
+    if (wf->wf_loop && ((size_t)wf->wf_queue_length < batch_size)) {
+      cdtime_t deadline = cdtime() + wf->wf_batch_max_age;
+      int rc = 0;
+      while (wf->wf_loop && ((size_t)wf->wf_queue_length < batch_size) &&
+             (rc == 0) && (cdtime() < deadline))
+        rc = pthread_cond_timedwait(&wf->wf_cond, &wf->wf_lock,
+                                    &CDTIME_T_TO_TIMESPEC(deadline));
+    }
+
+    while ((num < batch_size) && (wf->wf_queue_head != NULL)) {
+      write_queue_t *q = wf->wf_queue_head;
+      wf->wf_queue_head = q->next;
+      wf->wf_queue_length -= 1;
+      queued[num] = q;
+      num++;
+    }
+    if (wf->wf_queue_head == NULL) {
+      wf->wf_queue_tail = NULL;
+      assert(0 == wf->wf_queue_length);
+    }
+
+    if (wf->wf_block)
+      pthread_cond_broadcast(&wf->wf_cond_free);
+    pthread_mutex_unlock(&wf->wf_lock);
+
+    for (size_t i = 0; i < num; i++) {
+      queued_value_list_expand(queued[i]->qvl, vls + i);
+      entries[i] = (write_batch_entry_t){
+          .ds = queued[i]->ds,
+          .vl = vls + i,
+      };
+    }
+
+    (void)plugin_set_ctx(wf->wf_ctx);
+
+    callback_stats_mark_t mark;
+    callback_stats_begin(wf->wf_stats, &mark);
+    for (size_t i = 0; i < num; i++)
+      callback_stats_age(wf->wf_stats, &mark, queued[i]->dispatched);
+    plugin_write_batch_cb callback = wf->wf_callback;
+    (*callback)(entries, num, &wf->wf_udata);
+    callback_stats_end(wf->wf_stats, &mark);
+
+    for (size_t i = 0; i < num; i++) {
+      queued_value_list_destroy(queued[i]->qvl);
+      sfree(queued[i]);
+    }
+  }
+
+  sfree(queued);
+  sfree(vls);
+  sfree(entries);
+  pthread_exit(NULL);
+  return (void *)0;
+} /* }}} void *plugin_writer_batch_thread */
+
+static void start_writer_threads(write_func_t *wf, /* {{{ */
+                                 char const *name) {
+  if ((wf->wf_threads_num == 0) || (wf->wf_threads != NULL))
+    return;
+
+  wf->wf_threads = calloc(wf->wf_threads_num, sizeof(*wf->wf_threads));
+  if (wf->wf_threads == NULL) {
+    ERROR("plugin: start_writer_threads: calloc failed.");
+    return;
+  }
+
+  wf->wf_loop = true;
+
+  size_t num = 0;
+  for (size_t i = 0; i < wf->wf_threads_num; i++) {
+    int status = pthread_create(
+        wf->wf_threads + num, /* attr = */ NULL,
+        (wf->wf_batch_size > 0) ? plugin_writer_batch_thread
+                                : plugin_writer_thread,
+        /* arg = */ wf);
+    if (status != 0) {
+      ERROR("plugin: start_writer_threads: pthread_create failed with status "
+            "%i (%s).",
+            status, STRERROR(status));
+      break;
+    }
+
+    char thread_name[THREAD_NAME_MAX];
+    ssnprintf(thread_name, sizeof(thread_name), "%s#%" PRIu64, name,
+              (uint64_t)num);
+    set_thread_name(wf->wf_threads[num], thread_name);
+    thread_cpus_apply(wf->wf_threads[num], &write_thread_cpus,
+                      write_thread_cpus_next++, thread_name);
+
+    num++;
+  } /* for (i) */
+
+  if (num == 0) {
+    /* Fall back to being called by the global write threads. */
+    sfree(wf->wf_threads);
+    wf->wf_loop = false;
+    return;
+  }
+  wf->wf_threads_num = num;
+} /* }}} void start_writer_threads */
+
+static void stop_writer_threads(write_func_t *wf, char const *name) /* {{{ */
+{
+  size_t i;
+
+  if (wf->wf_threads == NULL)
+    return;
+
+  pthread_mutex_lock(&wf->wf_lock);
+  wf->wf_loop = false;
+  pthread_cond_broadcast(&wf->wf_cond);
+  pthread_cond_broadcast(&wf->wf_cond_free);
+  pthread_mutex_unlock(&wf->wf_lock);
+
+  for (i = 0; i < wf->wf_threads_num; i++) {
+    if (pthread_join(wf->wf_threads[i], NULL) != 0) {
+      ERROR("plugin: stop_writer_threads: pthread_join failed.");
+    }
+  }
+  sfree(wf->wf_threads);
+
+  pthread_mutex_lock(&wf->wf_lock);
+  i = 0;
+  for (write_queue_t *q = wf->wf_queue_head; q != NULL;) {
+    write_queue_t *q1 = q;
+    queued_value_list_destroy(q->qvl);
+    q = q->next;
+    sfree(q1);
+    i++;
+  }
+  wf->wf_queue_head = NULL;
+  wf->wf_queue_tail = NULL;
+  wf->wf_queue_length = 0;
+  pthread_mutex_unlock(&wf->wf_lock);
+
+  if (i > 0) {
+    WARNING("plugin: %" PRIsz " value list%s left in the queue of the "
+            "`%s' writer after shutting down its threads.",
+            i, (i == 1) ? " was" : "s were", name);
+  }
+} /* }}} void stop_writer_threads */
+
+static void start_all_writer_threads(void) /* {{{ */
+{
+  for (llentry_t *le = llist_head(list_write); le != NULL; le = le->next)
+    start_writer_threads(le->value, le->key);
+} /* }}} void start_all_writer_threads */
+
+static void stop_all_writer_threads(void) /* {{{ */
+{
+  for (llentry_t *le = llist_head(list_write); le != NULL; le = le->next)
+    stop_writer_threads(le->value, le->key);
+} /* }}} void stop_all_writer_threads */
+
+/* Returns true if the value should not be put into the writer's queue. Must
+ * be called with `wf_lock' held. */
+static bool writer_check_drop_value(write_func_t *wf, /* {{{ */
+                                    char const *name) {
+  if (wf->wf_limit_high == 0)
+    return false;
+
+  if (wf->wf_block) {
+    while (wf->wf_loop && (wf->wf_queue_length >= wf->wf_limit_high))
+      pthread_cond_wait(&wf->wf_cond_free, &wf->wf_lock);
+    return !wf->wf_loop;
+  }
+
+  double p = get_drop_probability(wf->wf_queue_length, wf->wf_limit_low,
+                                  wf->wf_limit_high);
+  if (p == 0.0)
+    return false;
+
+  cdtime_t now = cdtime();
+  if ((now - wf->wf_last_drop_message) > TIME_T_TO_CDTIME_T(1)) {
+    wf->wf_last_drop_message = now;
+    ERROR("plugin_write: Low water mark of the `%s' writer reached. "
+          "Dropping %.0f%% of metrics.",
+          name, 100.0 * p);
+  }
+
+  return (p == 1.0) || (cdrand_d() < p);
+} /* }}} bool writer_check_drop_value */
+
+static int plugin_writer_enqueue(write_func_t *wf, char const *name, /* {{{ */
+                                 const data_set_t *ds, const value_list_t *vl,
+                                 plugin_ctx_t ctx) {
+  write_queue_t *q;
+
+  q = malloc(sizeof(*q));
+  if (q == NULL)
+    return ENOMEM;
+  q->next = NULL;
+  q->ds = ds;
+  q->ctx = ctx;
+  q->dispatched = write_dispatched;
+
+  q->qvl = queued_value_list_create(vl);
+  if (q->qvl == NULL) {
+    sfree(q);
+    return ENOMEM;
+  }
+
+  pthread_mutex_lock(&wf->wf_lock);
+
+  if (!wf->wf_loop || writer_check_drop_value(wf, name)) {
+    wf->wf_dropped++;
+    pthread_mutex_unlock(&wf->wf_lock);
+    queued_value_list_destroy(q->qvl);
+    sfree(q);
+    return 0;
+  }
+
+  if (wf->wf_queue_tail == NULL) {
+    wf->wf_queue_head = q;
+    wf->wf_queue_tail = q;
+    wf->wf_queue_length = 1;
+  } else {
+    wf->wf_queue_tail->next = q;
+    wf->wf_queue_tail = q;
+    wf->wf_queue_length += 1;
+  }
+
+  /* Batch writers only need to be woken up for the first value list and once
+   * the batch is complete. */
+  if ((wf->wf_batch_size == 0) || (wf->wf_queue_length == 1) ||
+      ((size_t)wf->wf_queue_length >= wf->wf_batch_size))
+    pthread_cond_signal(&wf->wf_cond);
+  pthread_mutex_unlock(&wf->wf_lock);
+
+  return 0;
+} /* }}} int plugin_writer_enqueue */
+
+/* Hands the value list to a write callback, either by calling it directly or
+ * by putting it into the writer's private queue. */
+static int plugin_write_func_deliver(write_func_t *wf, /* {{{ */
+                                     char const *name, const data_set_t *ds,
+                                     const value_list_t *vl,
+                                     plugin_ctx_t ctx) {
+  if (wf->wf_threads != NULL)
+    return plugin_writer_enqueue(wf, name, ds, vl, ctx);
+
+  callback_stats_mark_t mark;
+  int status;
+
+  callback_stats_begin(wf->wf_stats, &mark);
+  callback_stats_age(wf->wf_stats, &mark, write_dispatched);
+  if (wf->wf_batch_size > 0) {
+    plugin_write_batch_cb callback = wf->wf_callback;
+    write_batch_entry_t entry = {
+        .ds = ds,
+        .vl = vl,
+    };
+    status = (*callback)(&entry, 1, &wf->wf_udata);
+  } else {
+    plugin_write_cb callback = wf->wf_callback;
+    status = (*callback)(ds, vl, &wf->wf_udata);
+  }
+  callback_stats_end(wf->wf_stats, &mark);
+
+  return status;
+} /* }}} int plugin_write_func_deliver */
+
+/* Like plugin_write_func_deliver(), but writers with a "Resolution" only get
+ * a value list once its window is complete. */
+static int plugin_write_func(write_func_t *wf, char const *name, /* {{{ */
+                             const data_set_t *ds, const value_list_t *vl,
+                             plugin_ctx_t ctx) {
+  if (wf->wf_resolution == NULL)
+    return plugin_write_func_deliver(wf, name, ds, vl, ctx);
+
+  write_resolution_value_t v;
+  int status = write_resolution_add(wf->wf_resolution, ds, vl, &v);
+  if ((status != 0) || (v.ds == NULL))
+    return status;
+
+  ctx.interval = v.vl.interval;
+  status = plugin_write_func_deliver(wf, name, v.ds, &v.vl, ctx);
+  write_resolution_value_free(&v);
+  return status;
+} /* }}} int plugin_write_func */
+
+/* Hands the windows of `wf' which are overdue at `now', or all windows if
+ * `now' is zero, to the writer. */
+static void plugin_write_resolution_flush(write_func_t *wf, /* {{{ */
+                                          char const *name, cdtime_t now) {
+  if (wf->wf_resolution == NULL)
+    return;
+
+  write_resolution_value_t *v = NULL;
+  size_t v_num = 0;
+  int status = write_resolution_flush(wf->wf_resolution, now, &v, &v_num);
+  if (status != 0)
+    ERROR("plugin: Consolidating the values of the `%s' writer failed: %s",
+          name, STRERROR(status));
+
+  plugin_ctx_t ctx = wf->wf_ctx;
+  ctx.interval = wf->wf_ctx.write_resolution;
+  plugin_ctx_t old_ctx = plugin_set_ctx(ctx);
+  for (size_t i = 0; i < v_num; i++)
+    plugin_write_func_deliver(wf, name, v[i].ds, &v[i].vl, ctx);
+  plugin_set_ctx(old_ctx);
+
+  write_resolution_values_free(v, v_num);
+} /* }}} void plugin_write_resolution_flush */
+
+static void plugin_write_resolution_flush_all(cdtime_t now) /* {{{ */
+{
+  for (llentry_t *le = llist_head(list_write); le != NULL; le = le->next)
+    plugin_write_resolution_flush(le->value, le->key, now);
+} /* }}} void plugin_write_resolution_flush_all */
+
+/*
+ * Public functions
+ */
+void plugin_set_dir(const char *dir) {
+  sfree(plugindir);
+
+  if (dir == NULL) {
+    plugindir = NULL;
+    return;
+  }
+
+  plugindir = strdup(dir);
+  if (plugindir == NULL)
+    ERROR("plugin_set_dir: strdup(\"%s\") failed", dir);
+}
+
+bool plugin_is_loaded(char const *name) {
+  if (plugins_loaded == NULL)
+    plugins_loaded =
+        c_avl_create((int (*)(const void *, const void *))strcasecmp);
+  assert(plugins_loaded != NULL);
+
+  int status = c_avl_get(plugins_loaded, name, /* ret_value = */ NULL);
+  return status == 0;
+}
+
+static int plugin_mark_loaded(char const *name) {
+  char *name_copy;
+  int status;
+
+  name_copy = strdup(name);
+  if (name_copy == NULL)
+    return ENOMEM;
+
+  status = c_avl_insert(plugins_loaded,
+                        /* key = */ name_copy, /* value = */ NULL);
+  return status;
+}
+
+static void plugin_free_loaded(void) {
+  void *key;
+  void *value;
+
+  if (plugins_loaded == NULL)
+    return;
+
+  while (c_avl_pick(plugins_loaded, &key, &value) == 0) {
+    sfree(key);
+    assert(value == NULL);
+  }
+
+  c_avl_destroy(plugins_loaded);
+  plugins_loaded = NULL;
+}
+
+#define BUFSIZE 512
+#ifdef WIN32
+#define SHLIB_SUFFIX ".dll"
+#else
+#define SHLIB_SUFFIX ".so"
+#endif
+int plugin_load(char const *plugin_name, bool global) {
+  DIR *dh;
+  const char *dir;
+  char filename[BUFSIZE] = "";
+  char typename[BUFSIZE];
+  int ret;
+  struct stat statbuf;
+  struct dirent *de;
+  int status;
+
+  if (plugin_name == NULL)
+    return EINVAL;
+
+  /* Check if plugin is already loaded and don't do anything in this
+   * case. */
+  if (plugin_is_loaded(plugin_name))
+    return 0;
+
+  dir = plugin_get_dir();
+  ret = 1;
+
+  /*
+   * XXX: Magic at work:
+   *
+   * Some of the language bindings, for example the Python and Perl
+   * plugins, need to be able to export symbols to the scripts they run.
+   * For this to happen, the "Globals" flag needs to be set.
    * Unfortunately, this technical detail is hard to explain to the
    * average user and she shouldn't have to worry about this, ideally.
    * So in order to save everyone's sanity use a different default for a
@@ -1066,24 +3452,67 @@ EXPORT int plugin_register_complex_config(const char *type,
   return cf_register_complex(type, callback);
 } /* int plugin_register_complex_config */
 
+EXPORT int plugin_register_reconfigure(const char *type,
+                                       int (*callback)(void)) {
+  return cf_register_complex_reconfigure(type, callback);
+} /* int plugin_register_reconfigure */
+
 EXPORT int plugin_register_init(const char *name, int (*callback)(void)) {
   return create_register_callback(&list_init, name, (void *)callback, NULL);
 } /* plugin_register_init */
 
-static int plugin_compare_read_func(const void *arg0, const void *arg1) {
-  const read_func_t *rf0;
-  const read_func_t *rf1;
+static void init_options_free(void *arg) /* {{{ */
+{
+  init_options_t *opts = arg;
 
-  rf0 = arg0;
-  rf1 = arg1;
+  if (opts == NULL)
+    return;
 
-  if (rf0->rf_next_read < rf1->rf_next_read)
-    return -1;
-  else if (rf0->rf_next_read > rf1->rf_next_read)
-    return 1;
-  else
-    return 0;
-} /* int plugin_compare_read_func */
+  sfree(opts->depends_on);
+  sfree(opts);
+} /* }}} void init_options_free */
+
+EXPORT int plugin_register_init_concurrent(const char *name, /* {{{ */
+                                           plugin_init_cb callback,
+                                           const char *depends_on) {
+  init_options_t *opts = calloc(1, sizeof(*opts));
+  if (opts == NULL) {
+    ERROR("plugin_register_init_concurrent: calloc failed.");
+    return ENOMEM;
+  }
+
+  if (depends_on != NULL) {
+    opts->depends_on = strdup(depends_on);
+    if (opts->depends_on == NULL) {
+      ERROR("plugin_register_init_concurrent: strdup failed.");
+      sfree(opts);
+      return ENOMEM;
+    }
+  }
+
+  user_data_t ud = {
+      .data = opts,
+      .free_func = init_options_free,
+  };
+
+  return create_register_callback(&list_init, name, (void *)callback, &ud);
+} /* }}} int plugin_register_init_concurrent */
+
+/* Returns the batch callback registered for `group'. Must hold `read_lock'
+ * when calling. */
+static read_group_t *read_group_find(const char *group) {
+  for (size_t i = 0; i < read_groups_num; i++)
+    if (strcmp(read_groups[i]->group, group) == 0)
+      return read_groups[i];
+  return NULL;
+} /* read_group_t *read_group_find */
+
+static void destroy_read_groups(void) {
+  for (size_t i = 0; i < read_groups_num; i++)
+    sfree(read_groups[i]);
+  sfree(read_groups);
+  read_groups_num = 0;
+} /* void destroy_read_groups */
 
 /* Add a read function to both, the heap and a linked list. The linked list if
  * used to look-up read functions, especially for the remove function. The heap
@@ -1094,6 +3523,7 @@ static int plugin_insert_read(read_func_t *rf) {
 
   rf->rf_next_read = cdtime();
   rf->rf_effective_interval = rf->rf_interval;
+  rf->rf_stretch = 1;
 
   pthread_mutex_lock(&read_lock);
 
@@ -1107,10 +3537,10 @@ static int plugin_insert_read(read_func_t *rf) {
   }
 
   if (read_heap == NULL) {
-    read_heap = c_heap_create(plugin_compare_read_func);
+    read_heap = c_timeheap_create();
     if (read_heap == NULL) {
       pthread_mutex_unlock(&read_lock);
-      ERROR("plugin_insert_read: c_heap_create failed.");
+      ERROR("plugin_insert_read: c_timeheap_create failed.");
       return -1;
     }
   }
@@ -1131,10 +3561,30 @@ static int plugin_insert_read(read_func_t *rf) {
     return -1;
   }
 
-  status = c_heap_insert(read_heap, rf);
+  callback_stats_attach((callback_func_t *)rf, /* age = */ false);
+
+  if ((rf->rf_type == RF_COMPLEX) && (rf->rf_group[0] != 0))
+    rf->rf_read_group = read_group_find(rf->rf_group);
+
+  /* Once the read threads are running, new read functions go to the thread
+   * with the fewest read functions, or to the one reading their group. */
+  read_sched_t *s = read_sched_least_loaded();
+  if ((s != NULL) && (rf->rf_read_group != NULL)) {
+    if (rf->rf_read_group->sched == NULL)
+      rf->rf_read_group->sched = s;
+    s = rf->rf_read_group->sched;
+  }
+  if (s != NULL) {
+    rf->rf_next_read += read_spread_offset(rf);
+    pthread_mutex_lock(&s->lock);
+    status = read_sched_insert(s, rf);
+    pthread_mutex_unlock(&s->lock);
+  } else {
+    status = c_timeheap_insert(read_heap, rf->rf_next_read, rf);
+  }
   if (status != 0) {
     pthread_mutex_unlock(&read_lock);
-    ERROR("plugin_insert_read: c_heap_insert failed.");
+    ERROR("plugin_insert_read: c_timeheap_insert failed.");
     llentry_destroy(le);
     return -1;
   }
@@ -1142,8 +3592,6 @@ static int plugin_insert_read(read_func_t *rf) {
   /* This does not fail. */
   llist_append(read_list, le);
 
-  /* Wake up all the read threads. */
-  pthread_cond_broadcast(&read_cond);
   pthread_mutex_unlock(&read_lock);
   return 0;
 } /* int plugin_insert_read */
@@ -1221,11 +3669,161 @@ EXPORT int plugin_register_complex_read(const char *group, const char *name,
   return status;
 } /* int plugin_register_complex_read */
 
+EXPORT int plugin_register_read_group(const char *group,
+                                      plugin_read_group_cb callback,
+                                      cdtime_t window) {
+  if ((group == NULL) || (group[0] == 0) || (callback == NULL))
+    return EINVAL;
+
+  if (window == 0)
+    window = plugin_get_interval() / 10;
+
+  pthread_mutex_lock(&read_lock);
+
+  read_group_t *rg = read_group_find(group);
+  if (rg == NULL) {
+    read_group_t **tmp =
+        realloc(read_groups, (read_groups_num + 1) * sizeof(*read_groups));
+    if (tmp == NULL) {
+      pthread_mutex_unlock(&read_lock);
+      ERROR("plugin_register_read_group: realloc failed.");
+      return ENOMEM;
+    }
+    read_groups = tmp;
+
+    rg = calloc(1, sizeof(*rg));
+    if (rg == NULL) {
+      pthread_mutex_unlock(&read_lock);
+      ERROR("plugin_register_read_group: calloc failed.");
+      return ENOMEM;
+    }
+    sstrncpy(rg->group, group, sizeof(rg->group));
+    read_groups[read_groups_num++] = rg;
+  }
+
+  rg->window = window;
+  __atomic_store_n(&rg->callback, callback, __ATOMIC_RELEASE);
+
+  /* Attach the read functions registered before. Those already handed to
+   * different read threads are batched per thread. */
+  if (read_list != NULL) {
+    for (llentry_t *le = llist_head(read_list); le != NULL; le = le->next) {
+      read_func_t *rf = le->value;
+      if ((rf->rf_type == RF_COMPLEX) && (strcmp(rf->rf_group, group) == 0))
+        __atomic_store_n(&rf->rf_read_group, rg, __ATOMIC_RELEASE);
+    }
+  }
+
+  pthread_mutex_unlock(&read_lock);
+  return 0;
+} /* int plugin_register_read_group */
+
+static int plugin_register_write_func(const char *name, /* {{{ */
+                                      void *callback, size_t batch_size,
+                                      cdtime_t batch_max_age,
+                                      user_data_t const *ud) {
+  if (name == NULL || callback == NULL)
+    return EINVAL;
+
+  write_func_t *wf = calloc(1, sizeof(*wf));
+  if (wf == NULL) {
+    free_userdata(ud);
+    ERROR("plugin_register_write: calloc failed.");
+    return ENOMEM;
+  }
+
+  wf->wf_callback = callback;
+  if (ud == NULL) {
+    wf->wf_udata = (user_data_t){
+        .data = NULL,
+        .free_func = NULL,
+    };
+  } else {
+    wf->wf_udata = *ud;
+  }
+  wf->wf_ctx = plugin_get_ctx();
+  wf->wf_batch_size = batch_size;
+  wf->wf_batch_max_age = batch_max_age;
+  if (wf->wf_ctx.write_resolution > 0) {
+    wf->wf_resolution =
+        write_resolution_create(wf->wf_ctx.write_resolution,
+                                wf->wf_ctx.write_resolution_function);
+    if (wf->wf_resolution == NULL) {
+      free_userdata(&wf->wf_udata);
+      sfree(wf);
+      ERROR("plugin_register_write: write_resolution_create failed.");
+      return ENOMEM;
+    }
+  }
+  callback_stats_attach((callback_func_t *)wf, /* age = */ true);
+
+  /* Batch writers always need a queue. */
+  if ((wf->wf_ctx.write_threads > 0) || (wf->wf_ctx.write_limit_high > 0) ||
+      (wf->wf_batch_size > 0)) {
+    wf->wf_threads_num =
+        (wf->wf_ctx.write_threads > 0) ? (size_t)wf->wf_ctx.write_threads : 1;
+    wf->wf_limit_high = (wf->wf_ctx.write_limit_high > 0)
+                            ? (long)wf->wf_ctx.write_limit_high
+                            : 0;
+    if (wf->wf_ctx.write_limit_low < 0)
+      wf->wf_limit_low = wf->wf_limit_high / 2;
+    else if (wf->wf_ctx.write_limit_low > wf->wf_limit_high) {
+      P_ERROR("WriteQueueLimitLow must not be larger than "
+              "WriteQueueLimitHigh.");
+      wf->wf_limit_low = wf->wf_limit_high;
+    } else
+      wf->wf_limit_low = (long)wf->wf_ctx.write_limit_low;
+    wf->wf_block = wf->wf_ctx.write_queue_block;
+
+    pthread_mutex_init(&wf->wf_lock, /* attr = */ NULL);
+    pthread_cond_init(&wf->wf_cond, /* attr = */ NULL);
+    pthread_cond_init(&wf->wf_cond_free, /* attr = */ NULL);
+  }
+
+  /* Replacing a writer which has its own threads requires them to be stopped
+   * first. */
+  if ((list_write != NULL) && (llist_search(list_write, name) != NULL)) {
+    P_WARNING("plugin_register_write: "
+              "a callback named `%s' already exists - "
+              "overwriting the old entry!",
+              name);
+    plugin_unregister_write(name);
+  }
+
+  int status = register_callback(&list_write, name, (callback_func_t *)wf);
+  if (status != 0)
+    return status;
+  write_handles_resolve(name, /* removed = */ NULL);
+
+  /* Writers registered after the write threads have been started, e.g. from
+   * an init callback, need to start their own threads right away. */
+  if (write_threads != NULL)
+    start_writer_threads(wf, name);
+
+  return 0;
+} /* }}} int plugin_register_write_func */
+
 EXPORT int plugin_register_write(const char *name, plugin_write_cb callback,
                                  user_data_t const *ud) {
-  return create_register_callback(&list_write, name, (void *)callback, ud);
+  return plugin_register_write_func(name, (void *)callback,
+                                    /* batch_size = */ 0,
+                                    /* batch_max_age = */ 0, ud);
 } /* int plugin_register_write */
 
+EXPORT int plugin_register_write_batch(const char *name,
+                                       plugin_write_batch_cb callback,
+                                       size_t batch_size,
+                                       cdtime_t batch_max_age,
+                                       user_data_t const *ud) {
+  if (batch_size == 0)
+    batch_size = WRITE_BATCH_DEFAULT_SIZE;
+  if (batch_max_age == 0)
+    batch_max_age = WRITE_BATCH_DEFAULT_MAX_AGE;
+
+  return plugin_register_write_func(name, (void *)callback, batch_size,
+                                    batch_max_age, ud);
+} /* int plugin_register_write_batch */
+
 static int plugin_flush_timeout_callback(user_data_t *ud) {
   flush_callback_t *cb = ud->data;
 
@@ -1378,37 +3976,113 @@ EXPORT int plugin_register_shutdown(const char *name, int (*callback)(void)) {
   return create_register_callback(&list_shutdown, name, (void *)callback, NULL);
 } /* int plugin_register_shutdown */
 
-static void plugin_free_data_sets(void) {
-  void *key;
-  void *value;
-
-  if (data_sets == NULL)
+static void plugin_free_data_set(data_set_t *ds) {
+  if (ds == NULL)
     return;
 
-  while (c_avl_pick(data_sets, &key, &value) == 0) {
-    data_set_t *ds = value;
-    /* key is a pointer to ds->type */
+  sfree(ds->ds);
+  sfree(ds);
+} /* void plugin_free_data_set */
 
-    sfree(ds->ds);
-    sfree(ds);
+static void plugin_free_data_sets(void) {
+  for (size_t i = 0; i < ds_entries_num; i++) {
+    plugin_free_data_set(ds_entries[i]->ds);
+    ds_plan_destroy(ds_entries[i]->plan);
+    sfree(ds_entries[i]);
   }
 
-  c_avl_destroy(data_sets);
-  data_sets = NULL;
+  sfree(ds_entries);
+  ds_entries_num = 0;
+
+  sfree(ds_index);
+  ds_index_size = 0;
 } /* void plugin_free_data_sets */
 
+/* Returns the entry of type `name', or NULL. */
+static data_set_entry_t *plugin_find_ds_entry(const char *name) {
+  if (ds_index_size == 0)
+    return NULL;
+
+  uint64_t hash = hash_name(name);
+  size_t mask = ds_index_size - 1;
+
+  for (size_t i = (size_t)hash & mask;; i = (i + 1) & mask) {
+    data_set_entry_t *e = ds_index[i];
+    if (e == NULL)
+      return NULL;
+    if ((e->hash == hash) && (strcmp(e->type, name) == 0))
+      return e;
+  }
+} /* data_set_entry_t *plugin_find_ds_entry */
+
+/* Returns the data set of type `name' without logging, or NULL. */
+static data_set_t *plugin_lookup_ds(const char *name) {
+  data_set_entry_t *e = plugin_find_ds_entry(name);
+
+  return (e != NULL) ? e->ds : NULL;
+} /* data_set_t *plugin_lookup_ds */
+
+static void plugin_index_ds_entry(data_set_entry_t *e) {
+  size_t mask = ds_index_size - 1;
+  size_t i = (size_t)e->hash & mask;
+
+  while (ds_index[i] != NULL)
+    i = (i + 1) & mask;
+  ds_index[i] = e;
+} /* void plugin_index_ds_entry */
+
+/* Returns the entry of type `name', creating it (and assigning the next
+ * handle) if necessary. */
+static data_set_entry_t *plugin_get_ds_entry(const char *name) {
+  data_set_entry_t *e = plugin_find_ds_entry(name);
+  if (e != NULL)
+    return e;
+
+  /* Keep the index at most half full. */
+  if (2 * (ds_entries_num + 1) > ds_index_size) {
+    size_t size = (ds_index_size == 0) ? 256 : 2 * ds_index_size;
+    data_set_entry_t **index = calloc(size, sizeof(*index));
+    if (index == NULL)
+      return NULL;
+
+    sfree(ds_index);
+    ds_index = index;
+    ds_index_size = size;
+    for (size_t i = 0; i < ds_entries_num; i++)
+      plugin_index_ds_entry(ds_entries[i]);
+  }
+
+  data_set_entry_t **tmp =
+      realloc(ds_entries, (ds_entries_num + 1) * sizeof(*ds_entries));
+  if (tmp == NULL)
+    return NULL;
+  ds_entries = tmp;
+
+  e = calloc(1, sizeof(*e));
+  if (e == NULL)
+    return NULL;
+  sstrncpy(e->type, name, sizeof(e->type));
+  e->hash = hash_name(e->type);
+  e->handle = (ds_handle_t)ds_entries_num;
+
+  plugin_index_ds_entry(e);
+  ds_entries[ds_entries_num] = e;
+  ds_entries_num++;
+  return e;
+} /* data_set_entry_t *plugin_get_ds_entry */
+
 EXPORT int plugin_register_data_set(const data_set_t *ds) {
   data_set_t *ds_copy;
 
-  if ((data_sets != NULL) && (c_avl_get(data_sets, ds->type, NULL) == 0)) {
+  if (plugin_lookup_ds(ds->type) != NULL) {
     NOTICE("Replacing DS `%s' with another version.", ds->type);
     plugin_unregister_data_set(ds->type);
-  } else if (data_sets == NULL) {
-    data_sets = c_avl_create((int (*)(const void *, const void *))strcmp);
-    if (data_sets == NULL)
-      return -1;
   }
 
+  data_set_entry_t *e = plugin_get_ds_entry(ds->type);
+  if (e == NULL)
+    return -1;
+
   ds_copy = malloc(sizeof(*ds_copy));
   if (ds_copy == NULL)
     return -1;
@@ -1423,7 +4097,15 @@ EXPORT int plugin_register_data_set(const data_set_t *ds) {
   for (size_t i = 0; i < ds->ds_num; i++)
     memcpy(ds_copy->ds + i, ds->ds + i, sizeof(data_source_t));
 
-  return c_avl_insert(data_sets, (void *)ds_copy->type, (void *)ds_copy);
+  ds_plan_t *plan = ds_plan_create(ds_copy);
+  if (plan == NULL) {
+    plugin_free_data_set(ds_copy);
+    return -1;
+  }
+
+  e->ds = ds_copy;
+  e->plan = plan;
+  return 0;
 } /* int plugin_register_data_set */
 
 EXPORT int plugin_register_log(const char *name, plugin_log_cb callback,
@@ -1478,7 +4160,7 @@ EXPORT int plugin_unregister_read(const char *name) /* {{{ */
 
   rf = le->value;
   assert(rf != NULL);
-  rf->rf_type = RF_REMOVE;
+  __atomic_store_n(&rf->rf_type, RF_REMOVE, __ATOMIC_RELEASE);
 
   pthread_mutex_unlock(&read_lock);
 
@@ -1513,6 +4195,11 @@ EXPORT int plugin_unregister_read_group(const char *group) /* {{{ */
 
   pthread_mutex_lock(&read_lock);
 
+  /* The batch callback goes with the read functions. */
+  read_group_t *rg = read_group_find(group);
+  if (rg != NULL)
+    __atomic_store_n(&rg->callback, NULL, __ATOMIC_RELEASE);
+
   if (read_list == NULL) {
     pthread_mutex_unlock(&read_lock);
     return -ENOENT;
@@ -1530,7 +4217,7 @@ EXPORT int plugin_unregister_read_group(const char *group) /* {{{ */
 
     rf = le->value;
     assert(rf != NULL);
-    rf->rf_type = RF_REMOVE;
+    __atomic_store_n(&rf->rf_type, RF_REMOVE, __ATOMIC_RELEASE);
 
     llentry_destroy(le);
 
@@ -1551,7 +4238,72 @@ EXPORT int plugin_unregister_read_group(const char *group) /* {{{ */
   return 0;
 } /* }}} int plugin_unregister_read_group */
 
+static int compare_read_func_plugin(llentry_t *e, void *ud) /* {{{ */
+{
+  read_func_t *rf = e->value;
+  char const *plugin = ud;
+
+  if (rf->rf_ctx.name == NULL)
+    return -1;
+  return strcasecmp(rf->rf_ctx.name, plugin);
+} /* }}} int compare_read_func_plugin */
+
+int plugin_unregister_read_plugin(const char *plugin) /* {{{ */
+{
+  int found = 0;
+
+  if (plugin == NULL)
+    return -ENOENT;
+
+  pthread_mutex_lock(&read_lock);
+
+  while (read_list != NULL) {
+    llentry_t *le =
+        llist_search_custom(read_list, compare_read_func_plugin, (void *)plugin);
+    if (le == NULL)
+      break;
+
+    ++found;
+
+    llist_remove(read_list, le);
+
+    read_func_t *rf = le->value;
+    assert(rf != NULL);
+    __atomic_store_n(&rf->rf_type, RF_REMOVE, __ATOMIC_RELEASE);
+
+    llentry_destroy(le);
+
+    DEBUG("plugin_unregister_read_plugin: "
+          "Marked `%s' (plugin `%s') for removal.",
+          rf->rf_name, plugin);
+  }
+
+  pthread_mutex_unlock(&read_lock);
+
+  return (found == 0) ? -ENOENT : 0;
+} /* }}} int plugin_unregister_read_plugin */
+
 EXPORT int plugin_unregister_write(const char *name) {
+  if (list_write == NULL)
+    return -1;
+
+  llentry_t *le = llist_search(list_write, name);
+  if (le == NULL)
+    return -1;
+
+  write_func_t *wf = le->value;
+  write_handles_resolve(le->key, /* removed = */ wf);
+  stop_writer_threads(wf, le->key);
+  /* The writer's threads are gone, so this calls the callback directly. */
+  plugin_write_resolution_flush(wf, le->key, /* now = */ 0);
+  write_resolution_destroy(wf->wf_resolution);
+  wf->wf_resolution = NULL;
+  if (wf->wf_threads_num > 0) {
+    pthread_mutex_destroy(&wf->wf_lock);
+    pthread_cond_destroy(&wf->wf_cond);
+    pthread_cond_destroy(&wf->wf_cond_free);
+  }
+
   return plugin_unregister(list_write, name);
 }
 
@@ -1599,34 +4351,232 @@ static void destroy_cache_event_callbacks() {
     sfree(cef->name);
     free_userdata(&cef->user_data);
   }
-}
+}
+
+EXPORT int plugin_unregister_shutdown(const char *name) {
+  return plugin_unregister(list_shutdown, name);
+}
+
+EXPORT int plugin_unregister_data_set(const char *name) {
+  data_set_entry_t *e = plugin_find_ds_entry(name);
+
+  if ((e == NULL) || (e->ds == NULL))
+    return -1;
+
+  /* The entry is kept, so the type keeps its handle. */
+  plugin_free_data_set(e->ds);
+  e->ds = NULL;
+  ds_plan_destroy(e->plan);
+  e->plan = NULL;
+
+  return 0;
+} /* int plugin_unregister_data_set */
+
+EXPORT int plugin_unregister_log(const char *name) {
+  return plugin_unregister(list_log, name);
+}
+
+EXPORT int plugin_unregister_notification(const char *name) {
+  return plugin_unregister(list_notification, name);
+}
+
+/* Calls a single init callback in the context of its plugin. */
+static int plugin_init_one(callback_func_t *cf, /* {{{ */
+                           cdtime_t *ret_duration) {
+  plugin_init_cb callback = cf->cf_callback;
+  cdtime_t start = cdtime();
+
+  plugin_ctx_t old_ctx = plugin_set_ctx(cf->cf_ctx);
+  int status = (*callback)();
+  plugin_set_ctx(old_ctx);
+
+  *ret_duration = cdtime() - start;
+  return status;
+} /* }}} int plugin_init_one */
+
+static int plugin_init_report(char const *name, int status, /* {{{ */
+                              cdtime_t duration) {
+  if (status != 0) {
+    ERROR("Initialization of plugin `%s' "
+          "failed with status %i. "
+          "Plugin will be unloaded.",
+          name, status);
+    /* Plugins that register read callbacks from the init
+     * callback should take care of appropriate error
+     * handling themselves. */
+    /* FIXME: Unload _all_ functions */
+    plugin_unregister_read(name);
+    return -1;
+  }
+
+  INFO("Initialization of plugin `%s' took %.3f seconds.", name,
+       CDTIME_T_TO_DOUBLE(duration));
+  return 0;
+} /* }}} int plugin_init_report */
+
+/* Returns true if all dependencies of "task" have been initialized. */
+static bool init_task_ready(init_group_t const *g, /* {{{ */
+                            init_task_t const *task) {
+  for (size_t i = 0; i < task->depends_num; i++)
+    if (!g->tasks[task->depends[i]].done)
+      return false;
+  return true;
+} /* }}} bool init_task_ready */
+
+static void *plugin_init_thread(void *arg) /* {{{ */
+{
+  init_group_t *g = arg;
+
+  pthread_mutex_lock(&g->lock);
+  while (g->started_num < g->tasks_num) {
+    init_task_t *task = NULL;
+
+    for (size_t i = 0; i < g->tasks_num; i++) {
+      if (!g->tasks[i].started && init_task_ready(g, g->tasks + i)) {
+        task = g->tasks + i;
+        break;
+      }
+    }
+
+    if ((task == NULL) && (g->running_num == 0)) {
+      /* Nothing is running and nothing is ready: the dependencies form a
+       * cycle. Break it by starting the first remaining callback. */
+      for (size_t i = 0; i < g->tasks_num; i++) {
+        if (!g->tasks[i].started) {
+          task = g->tasks + i;
+          break;
+        }
+      }
+      WARNING("plugin_init_all: The init dependencies of plugin `%s' form a "
+              "cycle. Initializing it anyway.",
+              task->name);
+    }
+
+    if (task == NULL) {
+      pthread_cond_wait(&g->cond, &g->lock);
+      continue;
+    }
+
+    task->started = true;
+    g->started_num++;
+    g->running_num++;
+    pthread_mutex_unlock(&g->lock);
+
+    DEBUG("plugin_init_all: Initializing plugin `%s'.", task->name);
+    int status = plugin_init_one(task->cf, &task->duration);
+
+    pthread_mutex_lock(&g->lock);
+    task->status = status;
+    task->done = true;
+    g->running_num--;
+    pthread_cond_broadcast(&g->cond);
+  }
+  pthread_mutex_unlock(&g->lock);
+
+  return NULL;
+} /* }}} void *plugin_init_thread */
+
+/* Looks up the dependencies of a concurrent init callback among the other
+ * callbacks in the group. Dependencies outside the group have either been
+ * initialized already, because their plugin was loaded earlier, or are not
+ * loaded at all. */
+static int init_task_resolve(init_task_t *tasks, size_t tasks_num, /* {{{ */
+                             size_t index) {
+  init_task_t *task = tasks + index;
+  init_options_t const *opts = task->cf->cf_udata.data;
+
+  if (opts->depends_on == NULL)
+    return 0;
+
+  char *buffer = strdup(opts->depends_on);
+  if (buffer == NULL)
+    return ENOMEM;
+
+  char *saveptr = NULL;
+  for (char *dep = strtok_r(buffer, ", \t", &saveptr); dep != NULL;
+       dep = strtok_r(NULL, ", \t", &saveptr)) {
+    for (size_t i = 0; i < tasks_num; i++) {
+      if ((i == index) || (strcasecmp(dep, tasks[i].name) != 0))
+        continue;
+
+      size_t *tmp =
+          realloc(task->depends, (task->depends_num + 1) * sizeof(*tmp));
+      if (tmp == NULL) {
+        sfree(buffer);
+        return ENOMEM;
+      }
+      task->depends = tmp;
+      task->depends[task->depends_num] = i;
+      task->depends_num++;
+      break;
+    }
+  }
 
-EXPORT int plugin_unregister_shutdown(const char *name) {
-  return plugin_unregister(list_shutdown, name);
-}
+  sfree(buffer);
+  return 0;
+} /* }}} int init_task_resolve */
+
+/* Runs a group of init callbacks registered with
+ * plugin_register_init_concurrent() on up to "threads_num" threads, honoring
+ * their dependencies. Results are reported in registration order. Frees the
+ * tasks' members. */
+static int plugin_init_concurrent(init_task_t *tasks, /* {{{ */
+                                  size_t tasks_num, size_t threads_num) {
+  init_group_t g = {
+      .lock = PTHREAD_MUTEX_INITIALIZER,
+      .cond = PTHREAD_COND_INITIALIZER,
+      .tasks = tasks,
+      .tasks_num = tasks_num,
+  };
+  int ret = 0;
 
-EXPORT int plugin_unregister_data_set(const char *name) {
-  data_set_t *ds;
+  for (size_t i = 0; i < tasks_num; i++) {
+    if (init_task_resolve(tasks, tasks_num, i) != 0)
+      ERROR("plugin_init_all: Resolving the init dependencies of plugin `%s' "
+            "failed. Not all of them may be honored.",
+            tasks[i].name);
+  }
 
-  if (data_sets == NULL)
-    return -1;
+  if (threads_num > tasks_num)
+    threads_num = tasks_num;
 
-  if (c_avl_remove(data_sets, name, NULL, (void *)&ds) != 0)
-    return -1;
+  pthread_t threads[threads_num];
+  size_t started = 0;
+  for (; started < threads_num; started++) {
+    int status = plugin_thread_create(threads + started, plugin_init_thread,
+                                      &g, "plugin init");
+    if (status != 0) {
+      ERROR("plugin_init_all: plugin_thread_create failed with status %i.",
+            status);
+      break;
+    }
+  }
 
-  sfree(ds->ds);
-  sfree(ds);
+  /* Without threads, initialize the remaining plugins from this thread. */
+  if (started == 0)
+    plugin_init_thread(&g);
 
-  return 0;
-} /* int plugin_unregister_data_set */
+  for (size_t i = 0; i < started; i++)
+    pthread_join(threads[i], NULL);
 
-EXPORT int plugin_unregister_log(const char *name) {
-  return plugin_unregister(list_log, name);
-}
+  for (size_t i = 0; i < tasks_num; i++) {
+    if (plugin_init_report(tasks[i].name, tasks[i].status,
+                           tasks[i].duration) != 0)
+      ret = -1;
+    sfree(tasks[i].name);
+    sfree(tasks[i].depends);
+  }
 
-EXPORT int plugin_unregister_notification(const char *name) {
-  return plugin_unregister(list_notification, name);
-}
+  pthread_cond_destroy(&g.cond);
+  pthread_mutex_destroy(&g.lock);
+  return ret;
+} /* }}} int plugin_init_concurrent */
+
+/* Memory is attributed to the plugin a thread is working for. */
+static char const *memstats_ctx_name(void) /* {{{ */
+{
+  return plugin_get_ctx().name;
+} /* }}} char const *memstats_ctx_name */
 
 EXPORT int plugin_init_all(void) {
   char const *chain_name;
@@ -1634,11 +4584,42 @@ EXPORT int plugin_init_all(void) {
   int status;
   int ret = 0;
 
+  bool collect_stats = IS_TRUE(global_option_get("CollectInternalStats"));
+
+  /* Containers created from now on are accounted, including the cache. */
+  if (collect_stats)
+    memstats_enable(memstats_ctx_name);
+
   /* Init the value cache */
   uc_init();
 
-  if (IS_TRUE(global_option_get("CollectInternalStats"))) {
+  /* Loaded before any value is dispatched, so the previous run's values are
+   * used to compute the first rates. */
+  char const *str = global_option_get("CacheFile");
+  if ((str != NULL) && (str[0] != 0)) {
+    cache_file = strdup(str);
+    cache_file_interval =
+        global_option_get_time("CacheFileInterval", TIME_T_TO_CDTIME_T(300));
+    cache_file_next = cdtime() + cache_file_interval;
+
+    status = (cache_file != NULL) ? uc_load_file(cache_file) : ENOMEM;
+    if ((status != 0) && (status != ENOENT))
+      WARNING("plugin_init_all: Loading the cache file `%s' failed: %s", str,
+              STRERROR(status));
+  }
+
+  if (collect_stats) {
     record_statistics = true;
+
+    /* Callbacks registered from now on get their statistics attached when
+     * they are registered. */
+    for (le = llist_head(list_write); le != NULL; le = le->next)
+      callback_stats_attach(le->value, /* age = */ true);
+    pthread_mutex_lock(&read_lock);
+    for (le = llist_head(read_list); le != NULL; le = le->next)
+      callback_stats_attach(le->value, /* age = */ false);
+    pthread_mutex_unlock(&read_lock);
+
     plugin_register_read("collectd", plugin_update_internal_statistics);
   }
 
@@ -1667,6 +4648,64 @@ EXPORT int plugin_init_all(void) {
     write_limit_low = write_limit_high;
   }
 
+  char const *policy = global_option_get("WriteQueuePolicy");
+  if ((policy == NULL) || (strcasecmp("Drop", policy) == 0))
+    write_queue_stretch = false;
+  else if (strcasecmp("Stretch", policy) == 0)
+    write_queue_stretch = true;
+  else
+    ERROR("Invalid WriteQueuePolicy \"%s\". Expected \"Drop\" or "
+          "\"Stretch\".",
+          policy);
+  write_latency_limit = global_option_get_time("WriteQueueLatencyLimit", 0);
+
+  char const *spool_dir = global_option_get("WriteQueueSpool");
+  if ((spool_dir != NULL) && (spool_dir[0] != 0) && (write_spool == NULL)) {
+    long size = global_option_get_long("WriteQueueSpoolSize",
+                                       /* default = */ 1024);
+    if (size < 1) {
+      ERROR("WriteQueueSpoolSize must be positive.");
+      size = 1024;
+    }
+    write_spool_high = global_option_get_long(
+        "WriteQueueSpoolThreshold",
+        /* default = */ (write_limit_low > 0) ? write_limit_low : 10000);
+    if (write_spool_high < 2) {
+      ERROR("WriteQueueSpoolThreshold must be at least 2.");
+      write_spool_high = 10000;
+    }
+    write_spool_low = write_spool_high / 2;
+    write_spool_rate = atof(global_option_get("WriteQueueSpoolReplayRate"));
+    if (write_spool_rate < 0.0) {
+      ERROR("WriteQueueSpoolReplayRate must be positive or zero.");
+      write_spool_rate = 0.0;
+    }
+
+    write_spool = c_spool_create(spool_dir, (uint64_t)size * 1024 * 1024,
+                                 /* segment_size = */ 0);
+    if (write_spool == NULL) {
+      ERROR("Opening the write queue spool in \"%s\" failed. Values that "
+            "don't fit into the write queue will be dropped.",
+            spool_dir);
+    } else if (c_spool_records(write_spool) > 0) {
+      /* Left over from the previous run; new values are queued behind. */
+      INFO("plugin: Replaying %" PRIu64 " value lists from the write queue "
+           "spool.",
+           c_spool_records(write_spool));
+      write_spool_active = true;
+    }
+  }
+
+  if ((read_thread_cpus.num_cgroups == 0) &&
+      (thread_cpus_parse("ReadThreadCPUs", global_option_get("ReadThreadCPUs"),
+                         &read_thread_cpus) != 0))
+    ret = -1;
+  if ((write_thread_cpus.num_cgroups == 0) &&
+      (thread_cpus_parse("WriteThreadCPUs",
+                         global_option_get("WriteThreadCPUs"),
+                         &write_thread_cpus) != 0))
+    ret = -1;
+
   write_threads_num = global_option_get_long("WriteThreads",
                                              /* default = */ 5);
   if (write_threads_num < 1) {
@@ -1674,110 +4713,634 @@ EXPORT int plugin_init_all(void) {
     write_threads_num = 5;
   }
 
+  long filter_threads_num = global_option_get_long("FilterThreads",
+                                                  /* default = */ 0);
+  if (filter_threads_num < 0) {
+    ERROR("FilterThreads must be positive or zero.");
+    filter_threads_num = 0;
+  }
+
+  char const *queue_type = global_option_get("WriteQueueType");
+  if (strcasecmp("Ring", queue_type) == 0) {
+    long size = global_option_get_long("WriteQueueSize", /* default = */ 65536);
+    if (size < 2) {
+      ERROR("WriteQueueSize must be at least 2.");
+      size = 65536;
+    }
+    if ((write_limit_high > 0) && (write_limit_high > size))
+      WARNING("WriteQueueLimitHigh (%ld) is larger than WriteQueueSize (%ld). "
+              "Dispatching will block when the write queue is full.",
+              write_limit_high, size);
+
+    if (write_ring == NULL) {
+#if HAVE_PTHREAD_SETAFFINITY_NP
+      /* c_ring_create() initializes every slot, so the ring's memory ends up
+       * on the NUMA node of the write threads. */
+      cpu_set_t saved;
+      bool pinned = thread_cpus_enter(&write_thread_cpus, &saved);
+#endif
+      write_ring = c_ring_create((size_t)size, sizeof(write_queue_t));
+#if HAVE_PTHREAD_SETAFFINITY_NP
+      if (pinned)
+        pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+#endif
+    }
+    if (write_ring == NULL)
+      ERROR("Creating the write queue ring failed. "
+            "Falling back to the default write queue.");
+  } else if (strcasecmp("List", queue_type) != 0) {
+    ERROR("Invalid WriteQueueType \"%s\". Expected \"List\" or \"Ring\".",
+          queue_type);
+  }
+
+  long notif_threads_num = global_option_get_long("NotificationThreads",
+                                                 /* default = */ 1);
+  if (notif_threads_num < 0) {
+    ERROR("NotificationThreads must be positive or zero.");
+    notif_threads_num = 1;
+  }
+
+  notif_queue_limit = global_option_get_long("NotificationQueueLimit",
+                                             /* default = */ 10000);
+  if (notif_queue_limit < 0) {
+    ERROR("NotificationQueueLimit must be positive or zero.");
+    notif_queue_limit = 10000;
+  }
+
+  if ((notif_threads_num > 0) && (notif_pending == NULL) &&
+      IS_TRUE(global_option_get("NotificationCoalesce")))
+    notif_pending = c_avl_create((int (*)(const void *, const void *))strcmp);
+
   if ((list_init == NULL) && (read_heap == NULL))
     return ret;
 
+  long init_threads_num = global_option_get_long("InitThreads",
+                                                /* default = */ 1);
+  if (init_threads_num < 1) {
+    ERROR("InitThreads must be positive.");
+    init_threads_num = 1;
+  }
+
   /* Calling all init callbacks before checking if read callbacks
    * are available allows the init callbacks to register the read
    * callback. */
+  cdtime_t init_start = cdtime();
+  size_t init_num = 0;
+  init_task_t *group = NULL;
+  size_t group_num = 0;
+
   le = llist_head(list_init);
   while (le != NULL) {
-    callback_func_t *cf;
-    plugin_init_cb callback;
+    callback_func_t *cf = le->value;
+    init_num++;
+
+    /* Consecutive concurrent init callbacks are collected and run together
+     * before the next regular init callback, so regular init callbacks still
+     * run after all init callbacks of the plugins loaded before them. */
+    if ((init_threads_num > 1) && (cf->cf_udata.data != NULL)) {
+      init_task_t *tmp = realloc(group, (group_num + 1) * sizeof(*group));
+      char *name = strdup(le->key);
+      if ((tmp != NULL) && (name != NULL)) {
+        group = tmp;
+        group[group_num] = (init_task_t){.name = name, .cf = cf};
+        group_num++;
+        le = le->next;
+        continue;
+      }
+      if (tmp != NULL)
+        group = tmp;
+      sfree(name);
+      ERROR("plugin_init_all: Allocating memory failed. Initializing "
+            "plugin `%s' on its own.",
+            le->key);
+    }
+
+    if (group_num > 0) {
+      if (plugin_init_concurrent(group, group_num, (size_t)init_threads_num) !=
+          0)
+        ret = -1;
+      group_num = 0;
+    }
+
+    cdtime_t duration = 0;
+    status = plugin_init_one(cf, &duration);
+    if (plugin_init_report(le->key, status, duration) != 0)
+      ret = -1;
+
+    le = le->next;
+  }
+
+  if (group_num > 0) {
+    if (plugin_init_concurrent(group, group_num, (size_t)init_threads_num) !=
+        0)
+      ret = -1;
+  }
+  sfree(group);
+
+  if (init_num > 0)
+    INFO("Initialized %" PRIsz " plugin(s) in %.3f seconds.", init_num,
+         CDTIME_T_TO_DOUBLE(cdtime() - init_start));
+
+  start_all_writer_threads();
+  start_filter_threads((size_t)filter_threads_num);
+  start_write_threads((size_t)write_threads_num);
+  start_write_spool_thread();
+  start_notification_threads((size_t)notif_threads_num);
+
+  max_read_interval =
+      global_option_get_time("MaxReadInterval", DEFAULT_MAX_READ_INTERVAL);
+
+  /* Start read-threads */
+  if (read_heap != NULL) {
+    const char *rt;
+    int num;
+
+    read_spread = IS_TRUE(global_option_get("SpreadReads"));
+
+    rt = global_option_get("ReadThreads");
+    num = atoi(rt);
+    if (num != -1)
+      start_read_threads((num > 0) ? ((size_t)num) : 5);
+  }
+  return ret;
+} /* void plugin_init_all */
+
+/* Initializes a plugin loaded after plugin_init_all() ran, see cf_reload(). */
+int plugin_init_plugin(char const *name) /* {{{ */
+{
+  int ret = 0;
+
+  for (llentry_t *le = llist_head(list_init); le != NULL; le = le->next) {
+    callback_func_t *cf = le->value;
+    if ((cf->cf_ctx.name == NULL) || (strcasecmp(cf->cf_ctx.name, name) != 0))
+      continue;
+
+    cdtime_t duration = 0;
+    int status = plugin_init_one(cf, &duration);
+    if (plugin_init_report(le->key, status, duration) != 0)
+      ret = -1;
+  }
+
+  start_all_writer_threads();
+
+  return ret;
+} /* }}} int plugin_init_plugin */
+
+/* TODO: Rename this function. */
+static void plugin_save_cache_file(void) /* {{{ */
+{
+  if (cache_file == NULL)
+    return;
+
+  int status = uc_save_file(cache_file);
+  if (status != 0)
+    ERROR("plugin: Writing the cache file `%s' failed: %s", cache_file,
+          STRERROR(status));
+} /* }}} void plugin_save_cache_file */
+
+EXPORT void plugin_read_all(void) {
+  uc_check_timeout();
+  plugin_write_resolution_flush_all(cdtime());
+  identifier_intern_gc();
+
+  if ((cache_file != NULL) && (cdtime() >= cache_file_next)) {
+    plugin_save_cache_file();
+    cache_file_next = cdtime() + cache_file_interval;
+  }
+
+  return;
+} /* void plugin_read_all */
+
+/* Read function called when the `-T' command line argument is given. */
+EXPORT int plugin_read_all_once(void) {
+  int status;
+  int return_status = 0;
+
+  if (read_heap == NULL) {
+    NOTICE("No read-functions are registered.");
+    return 0;
+  }
+
+  while (42) {
+    read_func_t *rf;
     plugin_ctx_t old_ctx;
 
-    cf = le->value;
-    old_ctx = plugin_set_ctx(cf->cf_ctx);
-    callback = cf->cf_callback;
-    status = (*callback)();
+    rf = c_timeheap_get_root(read_heap, NULL);
+    if (rf == NULL)
+      break;
+
+    cdtime_cache_set(cdtime());
+    old_ctx = plugin_set_ctx(rf->rf_ctx);
+
+    if (rf->rf_type == RF_SIMPLE) {
+      int (*callback)(void);
+
+      callback = rf->rf_callback;
+      status = (*callback)();
+    } else {
+      plugin_read_cb callback;
+
+      callback = rf->rf_callback;
+      status = (*callback)(&rf->rf_udata);
+    }
+
+    plugin_set_ctx(old_ctx);
+    cdtime_cache_set(0);
+
+    if (status != 0) {
+      NOTICE("read-function of plugin `%s' failed.", rf->rf_name);
+      return_status = -1;
+    }
+
+    sfree(rf->rf_name);
+    destroy_callback((void *)rf);
+  }
+
+  return return_status;
+} /* int plugin_read_all_once */
+
+/*
+ * Benchmark mode, see the `-b' command line option.
+ */
+/* Number of distinct series in the synthetic stream handed to writers. */
+#define BENCH_SERIES 100
+
+typedef struct {
+  char const *name;
+  size_t calls;
+  size_t failed;
+  cdtime_t time;
+  cdtime_t cpu_time;
+  long ctx_switches;
+  long faults;
+  long blocks;
+  uint64_t values;
+  int64_t heap;
+} bench_result_t;
+
+typedef struct {
+  cdtime_t time;
+  cdtime_t cpu_time;
+#if HAVE_SYS_RESOURCE_H
+  struct rusage usage;
+#endif
+  uint64_t values;
+  int64_t heap;
+} bench_mark_t;
+
+#if HAVE_SYS_RESOURCE_H
+static void bench_rusage(struct rusage *ru) /* {{{ */
+{
+#ifdef RUSAGE_THREAD
+  if (getrusage(RUSAGE_THREAD, ru) == 0)
+    return;
+#endif
+  if (getrusage(RUSAGE_SELF, ru) != 0)
+    memset(ru, 0, sizeof(*ru));
+} /* }}} void bench_rusage */
+#endif
+
+/* Bytes currently allocated from the heap by the whole process. */
+static int64_t bench_heap_used(void) /* {{{ */
+{
+#if HAVE_MALLINFO2
+  struct mallinfo2 mi = mallinfo2();
+  return (int64_t)(mi.uordblks + mi.hblkhd);
+#else
+  return 0;
+#endif
+} /* }}} int64_t bench_heap_used */
+
+static void bench_begin(bench_mark_t *m) /* {{{ */
+{
+#if HAVE_SYS_RESOURCE_H
+  bench_rusage(&m->usage);
+#endif
+  m->heap = bench_heap_used();
+  m->values = write_enqueued;
+  m->cpu_time = thread_cpu_time();
+  m->time = cdtime();
+} /* }}} void bench_begin */
+
+static void bench_end(bench_result_t *r, bench_mark_t const *m) /* {{{ */
+{
+  r->time += cdtime() - m->time;
+  r->cpu_time += thread_cpu_time() - m->cpu_time;
+  r->values += write_enqueued - m->values;
+  r->heap += bench_heap_used() - m->heap;
+#if HAVE_SYS_RESOURCE_H
+  struct rusage ru;
+  bench_rusage(&ru);
+  r->ctx_switches += (ru.ru_nvcsw - m->usage.ru_nvcsw) +
+                     (ru.ru_nivcsw - m->usage.ru_nivcsw);
+  r->faults += (ru.ru_minflt - m->usage.ru_minflt) +
+               (ru.ru_majflt - m->usage.ru_majflt);
+  r->blocks += (ru.ru_inblock - m->usage.ru_inblock) +
+               (ru.ru_oublock - m->usage.ru_oublock);
+#endif
+} /* }}} void bench_end */
+
+typedef struct {
+  read_func_t **rfs;
+  bench_result_t *results;
+  size_t num;
+  size_t next;
+  size_t iterations;
+} bench_reads_t;
+
+static void bench_read_one(read_func_t *rf, bench_result_t *r, /* {{{ */
+                           size_t iterations) {
+  bench_mark_t mark;
+
+  r->name = rf->rf_name;
+  bench_begin(&mark);
+  for (size_t i = 0; i < iterations; i++) {
+    int status;
+
+    cdtime_cache_set(cdtime());
+    plugin_ctx_t old_ctx = plugin_set_ctx(rf->rf_ctx);
+    if (rf->rf_type == RF_SIMPLE) {
+      int (*callback)(void) = rf->rf_callback;
+      status = (*callback)();
+    } else {
+      plugin_read_cb callback = rf->rf_callback;
+      status = (*callback)(&rf->rf_udata);
+    }
     plugin_set_ctx(old_ctx);
+    cdtime_cache_set(0);
+
+    r->calls++;
+    if (status != 0)
+      r->failed++;
+  }
+  bench_end(r, &mark);
+} /* }}} void bench_read_one */
+
+/* Takes read functions off the shared list until it is exhausted, so that
+ * `-j' threads benchmark different callbacks at the same time. A single
+ * callback is never run concurrently with itself. */
+static void *bench_read_thread(void *arg) /* {{{ */
+{
+  bench_reads_t *b = arg;
+
+  while (42) {
+    size_t i = __atomic_fetch_add(&b->next, 1, __ATOMIC_RELAXED);
+    if (i >= b->num)
+      break;
+    bench_read_one(b->rfs[i], b->results + i, b->iterations);
+  }
+  return NULL;
+} /* }}} void *bench_read_thread */
+
+/* Waits up to ten seconds for the write threads to catch up, so that writers
+ * are benchmarked without competing with the values from the read
+ * benchmark. */
+static void bench_drain_writes(void) /* {{{ */
+{
+  cdtime_t end = cdtime() + TIME_T_TO_CDTIME_T(10);
+
+  while (cdtime() < end) {
+    long length = plugin_write_queue_length();
+
+    for (llentry_t *le = llist_head(list_write); le != NULL; le = le->next) {
+      write_func_t *wf = le->value;
+      pthread_mutex_lock(&wf->wf_lock);
+      length += wf->wf_queue_length;
+      pthread_mutex_unlock(&wf->wf_lock);
+    }
+    if (length == 0)
+      return;
+
+    struct timespec ts = CDTIME_T_TO_TIMESPEC(MS_TO_CDTIME_T(10));
+    nanosleep(&ts, NULL);
+  }
+  WARNING("plugin: The write queue did not drain before benchmarking the "
+          "write callbacks.");
+} /* }}} void bench_drain_writes */
+
+/* Fills `vl' with the `n'th value list of the synthetic stream: a gauge per
+ * series, BENCH_SERIES series, one value per series and interval. */
+static void bench_value_list(value_list_t *vl, value_t *v, size_t n, /* {{{ */
+                             cdtime_t start, cdtime_t interval) {
+  *v = (value_t){.gauge = (gauge_t)n};
+  *vl = (value_list_t){
+      .values = v,
+      .values_len = 1,
+      .time = start + (cdtime_t)(n / BENCH_SERIES) * interval,
+      .interval = interval,
+  };
+  sstrncpy(vl->host, hostname_g, sizeof(vl->host));
+  sstrncpy(vl->plugin, "benchmark", sizeof(vl->plugin));
+  sstrncpy(vl->type, "gauge", sizeof(vl->type));
+  ssnprintf(vl->type_instance, sizeof(vl->type_instance), "%zu",
+            n % BENCH_SERIES);
+} /* }}} void bench_value_list */
+
+static int bench_write_one(char const *name, write_func_t *wf, /* {{{ */
+                           data_set_t const *ds, bench_result_t *r,
+                           size_t values) {
+  size_t batch_size = (wf->wf_batch_size > 0) ? wf->wf_batch_size : 1;
+  cdtime_t interval = plugin_get_interval();
+  cdtime_t start = cdtime();
+  bench_mark_t mark;
+
+  r->name = name;
+
+  value_list_t *vls = calloc(batch_size, sizeof(*vls));
+  value_t *vs = calloc(batch_size, sizeof(*vs));
+  write_batch_entry_t *entries = calloc(batch_size, sizeof(*entries));
+  if ((vls == NULL) || (vs == NULL) || (entries == NULL)) {
+    ERROR("plugin_bench_all: calloc failed.");
+    sfree(vls);
+    sfree(vs);
+    sfree(entries);
+    return ENOMEM;
+  }
+
+  bench_begin(&mark);
+  plugin_ctx_t old_ctx = plugin_set_ctx(wf->wf_ctx);
+  for (size_t n = 0; n < values; n += batch_size) {
+    size_t num = values - n;
+    if (num > batch_size)
+      num = batch_size;
+
+    for (size_t i = 0; i < num; i++) {
+      bench_value_list(vls + i, vs + i, n + i, start, interval);
+      entries[i] = (write_batch_entry_t){.ds = ds, .vl = vls + i};
+    }
+
+    int status;
+    if (wf->wf_batch_size > 0) {
+      plugin_write_batch_cb callback = wf->wf_callback;
+      status = (*callback)(entries, num, &wf->wf_udata);
+    } else {
+      plugin_write_cb callback = wf->wf_callback;
+      status = (*callback)(ds, vls, &wf->wf_udata);
+    }
+
+    r->calls += num;
+    if (status != 0)
+      r->failed += num;
+  }
+  plugin_set_ctx(old_ctx);
+  /* Writers that buffer only pay for the values once they are flushed. */
+  plugin_flush(name, 0, NULL);
+  bench_end(r, &mark);
+
+  sfree(vls);
+  sfree(vs);
+  sfree(entries);
+  return 0;
+} /* }}} int bench_write_one */
+
+static void bench_print(char const *kind, bench_result_t const *r, /* {{{ */
+                        size_t num) {
+  printf("%-32s %8s %7s %11s %11s %7s %7s %7s %8s %10s\n", kind, "calls",
+         "failed", "wall[us]", "cpu[us]", "ctxsw", "faults", "blocks",
+         "values", "heap[B]");
+  for (size_t i = 0; i < num; i++) {
+    double calls = (r[i].calls > 0) ? (double)r[i].calls : 1.0;
+    printf("%-32s %8zu %7zu %11.1f %11.1f %7.1f %7.1f %7.1f %8.1f %10.0f\n",
+           r[i].name, r[i].calls, r[i].failed,
+           1e6 * CDTIME_T_TO_DOUBLE(r[i].time) / calls,
+           1e6 * CDTIME_T_TO_DOUBLE(r[i].cpu_time) / calls,
+           (double)r[i].ctx_switches / calls, (double)r[i].faults / calls,
+           (double)r[i].blocks / calls, (double)r[i].values / calls,
+           (double)r[i].heap / calls);
+  }
+  printf("\n");
+} /* }}} void bench_print */
+
+/* Runs bench_read_thread() in the calling thread and `threads - 1' others. */
+static void bench_reads_run(bench_reads_t *b, size_t threads) /* {{{ */
+{
+  pthread_t tids[threads];
+  size_t tids_num = 0;
+
+  for (size_t i = 1; i < threads; i++) {
+    int status =
+        plugin_thread_create(tids + tids_num, bench_read_thread, b, "bench");
+    if (status != 0) {
+      ERROR("plugin_bench_all: plugin_thread_create failed: %s",
+            STRERROR(status));
+      break;
+    }
+    tids_num++;
+  }
+
+  bench_read_thread(b);
+  for (size_t i = 0; i < tids_num; i++)
+    pthread_join(tids[i], NULL);
+} /* }}} void bench_reads_run */
+
+static int bench_reads(size_t iterations, size_t threads) /* {{{ */
+{
+  bench_reads_t b = {.iterations = iterations};
+  int ret = 0;
+
+  if (read_heap == NULL) {
+    NOTICE("No read-functions are registered.");
+    return 0;
+  }
 
-    if (status != 0) {
-      ERROR("Initialization of plugin `%s' "
-            "failed with status %i. "
-            "Plugin will be unloaded.",
-            le->key, status);
-      /* Plugins that register read callbacks from the init
-       * callback should take care of appropriate error
-       * handling themselves. */
-      /* FIXME: Unload _all_ functions */
-      plugin_unregister_read(le->key);
+  read_func_t *rf;
+  while ((rf = c_timeheap_get_root(read_heap, NULL)) != NULL) {
+    read_func_t **tmp = realloc(b.rfs, (b.num + 1) * sizeof(*b.rfs));
+    if (tmp == NULL) {
+      ERROR("plugin_bench_all: realloc failed.");
+      sfree(rf->rf_name);
+      destroy_callback((void *)rf);
       ret = -1;
+      continue;
     }
-
-    le = le->next;
+    b.rfs = tmp;
+    b.rfs[b.num++] = rf;
   }
 
-  start_write_threads((size_t)write_threads_num);
+  if (b.num == 0)
+    goto out;
 
-  max_read_interval =
-      global_option_get_time("MaxReadInterval", DEFAULT_MAX_READ_INTERVAL);
+  b.results = calloc(b.num, sizeof(*b.results));
+  if (b.results == NULL) {
+    ERROR("plugin_bench_all: calloc failed.");
+    ret = -1;
+    goto out;
+  }
 
-  /* Start read-threads */
-  if (read_heap != NULL) {
-    const char *rt;
-    int num;
+  if (threads > b.num)
+    threads = b.num;
+  bench_reads_run(&b, threads);
+
+  if (threads > 1)
+    printf("Heap growth is process wide and includes the other %zu "
+           "thread(s).\n",
+           threads - 1);
+  bench_print("read callback (per call)", b.results, b.num);
+  for (size_t i = 0; i < b.num; i++)
+    if (b.results[i].failed > 0)
+      ret = -1;
 
-    rt = global_option_get("ReadThreads");
-    num = atoi(rt);
-    if (num != -1)
-      start_read_threads((num > 0) ? ((size_t)num) : 5);
+out:
+  for (size_t i = 0; i < b.num; i++) {
+    sfree(b.rfs[i]->rf_name);
+    destroy_callback((void *)b.rfs[i]);
   }
+  sfree(b.rfs);
+  sfree(b.results);
   return ret;
-} /* void plugin_init_all */
-
-/* TODO: Rename this function. */
-EXPORT void plugin_read_all(void) {
-  uc_check_timeout();
-
-  return;
-} /* void plugin_read_all */
+} /* }}} int bench_reads */
 
-/* Read function called when the `-T' command line argument is given. */
-EXPORT int plugin_read_all_once(void) {
-  int status;
-  int return_status = 0;
+static int bench_writes(size_t values) /* {{{ */
+{
+  int ret = 0;
 
-  if (read_heap == NULL) {
-    NOTICE("No read-functions are registered.");
+  if (llist_size(list_write) <= 0)
     return 0;
-  }
-
-  while (42) {
-    read_func_t *rf;
-    plugin_ctx_t old_ctx;
 
-    rf = c_heap_get_root(read_heap);
-    if (rf == NULL)
-      break;
+  data_set_t const *ds = plugin_get_ds("gauge");
+  if (ds == NULL) {
+    ERROR("plugin_bench_all: Unable to look up type `gauge'; not "
+          "benchmarking write callbacks.");
+    return -1;
+  }
 
-    old_ctx = plugin_set_ctx(rf->rf_ctx);
+  bench_drain_writes();
 
-    if (rf->rf_type == RF_SIMPLE) {
-      int (*callback)(void);
+  size_t num = (size_t)llist_size(list_write);
+  bench_result_t results[num];
+  memset(results, 0, sizeof(results));
 
-      callback = rf->rf_callback;
-      status = (*callback)();
-    } else {
-      plugin_read_cb callback;
+  size_t i = 0;
+  for (llentry_t *le = llist_head(list_write); (le != NULL) && (i < num);
+       le = le->next, i++)
+    if (bench_write_one(le->key, le->value, ds, results + i, values) != 0)
+      ret = -1;
 
-      callback = rf->rf_callback;
-      status = (*callback)(&rf->rf_udata);
-    }
+  bench_print("write callback (per value)", results, i);
+  for (size_t j = 0; j < i; j++)
+    if (results[j].failed > 0)
+      ret = -1;
+  return ret;
+} /* }}} int bench_writes */
 
-    plugin_set_ctx(old_ctx);
+/* Benchmarks the read and write callbacks when the `-b' command line argument
+ * is given. */
+EXPORT int plugin_bench_all(size_t iterations, size_t threads) /* {{{ */
+{
+  int ret = 0;
 
-    if (status != 0) {
-      NOTICE("read-function of plugin `%s' failed.", rf->rf_name);
-      return_status = -1;
-    }
+  if (iterations == 0)
+    iterations = 1;
+  if (threads == 0)
+    threads = 1;
 
-    sfree(rf->rf_name);
-    destroy_callback((void *)rf);
-  }
+  if (bench_reads(iterations, threads) != 0)
+    ret = -1;
+  if (bench_writes(iterations) != 0)
+    ret = -1;
 
-  return return_status;
-} /* int plugin_read_all_once */
+  return ret;
+} /* }}} int plugin_bench_all */
 
 EXPORT int plugin_write(const char *plugin, /* {{{ */
                         const data_set_t *ds, const value_list_t *vl) {
@@ -1804,19 +5367,17 @@ EXPORT int plugin_write(const char *plugin, /* {{{ */
 
     le = llist_head(list_write);
     while (le != NULL) {
-      callback_func_t *cf = le->value;
-      plugin_write_cb callback;
+      write_func_t *wf = le->value;
 
       /* Keep the read plugin's interval and flush information but update the
        * plugin name. */
       plugin_ctx_t old_ctx = plugin_get_ctx();
       plugin_ctx_t ctx = old_ctx;
-      ctx.name = cf->cf_ctx.name;
+      ctx.name = wf->wf_ctx.name;
       plugin_set_ctx(ctx);
 
       DEBUG("plugin: plugin_write: Writing values via %s.", le->key);
-      callback = cf->cf_callback;
-      status = (*callback)(ds, vl, &cf->cf_udata);
+      status = plugin_write_func(wf, le->key, ds, vl, ctx);
       if (status != 0)
         failure++;
       else
@@ -1832,9 +5393,6 @@ EXPORT int plugin_write(const char *plugin, /* {{{ */
       status = 0;
   } else /* plugin != NULL */
   {
-    callback_func_t *cf;
-    plugin_write_cb callback;
-
     le = llist_head(list_write);
     while (le != NULL) {
       if (strcasecmp(plugin, le->key) == 0)
@@ -1846,19 +5404,72 @@ EXPORT int plugin_write(const char *plugin, /* {{{ */
     if (le == NULL)
       return ENOENT;
 
-    cf = le->value;
-
     /* do not switch plugin context; rather keep the context (interval)
      * information of the calling read plugin */
 
     DEBUG("plugin: plugin_write: Writing values via %s.", le->key);
-    callback = cf->cf_callback;
-    status = (*callback)(ds, vl, &cf->cf_udata);
+    status = plugin_write_func(le->value, le->key, ds, vl, plugin_get_ctx());
   }
 
   return status;
 } /* }}} int plugin_write */
 
+EXPORT plugin_write_handle_t *plugin_write_handle(char const *name) /* {{{ */
+{
+  if (name == NULL)
+    return NULL;
+
+  pthread_mutex_lock(&register_lock);
+  for (plugin_write_handle_t *h = write_handles; h != NULL; h = h->next) {
+    if (strcasecmp(name, h->name) == 0) {
+      pthread_mutex_unlock(&register_lock);
+      return h;
+    }
+  }
+
+  plugin_write_handle_t *h = calloc(1, sizeof(*h));
+  if (h == NULL) {
+    pthread_mutex_unlock(&register_lock);
+    ERROR("plugin_write_handle: calloc failed.");
+    return NULL;
+  }
+  h->name = strdup(name);
+  if (h->name == NULL) {
+    pthread_mutex_unlock(&register_lock);
+    ERROR("plugin_write_handle: strdup failed.");
+    sfree(h);
+    return NULL;
+  }
+  h->next = write_handles;
+  write_handles = h;
+  pthread_mutex_unlock(&register_lock);
+
+  write_handles_resolve(name, /* removed = */ NULL);
+  return h;
+} /* }}} plugin_write_handle_t *plugin_write_handle */
+
+EXPORT int plugin_write_to(plugin_write_handle_t *h, /* {{{ */
+                           const data_set_t *ds, const value_list_t *vl) {
+  if ((h == NULL) || (vl == NULL))
+    return EINVAL;
+
+  write_func_t *wf = __atomic_load_n(&h->wf, __ATOMIC_ACQUIRE);
+  if (wf == NULL)
+    return ENOENT;
+
+  if (ds == NULL) {
+    ds = plugin_get_ds(vl->type);
+    if (ds == NULL) {
+      ERROR("plugin_write_to: Unable to lookup type `%s'.", vl->type);
+      return ENOENT;
+    }
+  }
+
+  /* Like plugin_write(), keep the context of the calling read plugin. */
+  DEBUG("plugin: plugin_write_to: Writing values via %s.", h->name);
+  return plugin_write_func(wf, h->name, ds, vl, plugin_get_ctx());
+} /* }}} int plugin_write_to */
+
 EXPORT int plugin_flush(const char *plugin, cdtime_t timeout,
                         const char *identifier) {
   llentry_t *le;
@@ -1904,9 +5515,24 @@ EXPORT int plugin_shutdown_all(void) {
   pthread_mutex_unlock(&read_lock);
 
   destroy_read_heap();
+  destroy_read_groups();
+
+  /* Stopped first, so the write threads' queue no longer grows. */
+  stop_write_spool_thread();
 
   /* blocks until all write threads have shut down. */
   stop_write_threads();
+  stop_filter_threads();
+  stop_all_writer_threads();
+  stop_notification_threads();
+
+  /* Hand incomplete windows of writers with a "Resolution" to the callbacks
+   * directly, now that nothing else calls them. */
+  plugin_write_resolution_flush_all(/* now = */ 0);
+
+  /* No more values reach the cache. */
+  plugin_save_cache_file();
+  sfree(cache_file);
 
   /* ask all plugins to write out the state they kept. */
   plugin_flush(/* plugin = */ NULL,
@@ -1946,14 +5572,28 @@ EXPORT int plugin_shutdown_all(void) {
   destroy_all_callbacks(&list_flush);
   destroy_all_callbacks(&list_missing);
   destroy_cache_event_callbacks();
+  for (llentry_t *le = llist_head(list_write); le != NULL; le = le->next) {
+    write_func_t *wf = le->value;
+    write_resolution_destroy(wf->wf_resolution);
+    wf->wf_resolution = NULL;
+  }
   destroy_all_callbacks(&list_write);
+  write_handles_resolve(/* name = */ NULL, /* removed = */ NULL);
 
   destroy_all_callbacks(&list_notification);
   destroy_all_callbacks(&list_shutdown);
   destroy_all_callbacks(&list_log);
 
+  /* Nothing is dispatched any more. */
+  if (write_spool != NULL) {
+    c_spool_destroy(write_spool);
+    write_spool = NULL;
+  }
+
   plugin_free_loaded();
   plugin_free_data_sets();
+  config_cores_cleanup(&read_thread_cpus);
+  config_cores_cleanup(&write_thread_cpus);
   return ret;
 } /* void plugin_shutdown_all */
 
@@ -2062,7 +5702,9 @@ void plugin_dispatch_cache_event(enum cache_event_type_e event_type,
   return;
 }
 
-static int plugin_dispatch_values_internal(value_list_t *vl) {
+/* `ds' is the data set of `vl', or NULL if it has not been looked up yet. */
+static int plugin_dispatch_values_internal(value_list_t *vl, /* {{{ */
+                                           data_set_t const *ds) {
   int status;
   static c_complain_t no_write_complaint = C_COMPLAIN_INIT_STATIC;
 
@@ -2070,7 +5712,7 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
 
   assert(vl != NULL);
 
-  /* These fields are initialized by plugin_value_list_clone() if needed: */
+  /* These fields are initialized by queued_value_list_create() if needed: */
   assert(vl->host[0] != 0);
   assert(vl->time != 0); /* The time is determined at _enqueue_ time. */
   assert(vl->interval != 0);
@@ -2088,21 +5730,23 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
   if (vl->meta == NULL)
     free_meta_data = true;
 
+  /* Attached rates are those of an earlier dispatch. */
+  vl->rates = NULL;
+
   if (list_write == NULL)
     c_complain_once(LOG_WARNING, &no_write_complaint,
                     "plugin_dispatch_values: No write callback has been "
                     "registered. Please load at least one output plugin, "
                     "if you want the collected data to be stored.");
 
-  if (data_sets == NULL) {
+  if (ds_entries_num == 0) {
     ERROR("plugin_dispatch_values: No data sets registered. "
           "Could the types database be read? Check "
           "your `TypesDB' setting!");
     return -1;
   }
 
-  data_set_t *ds = NULL;
-  if (c_avl_get(data_sets, vl->type, (void *)&ds) != 0) {
+  if ((ds == NULL) && ((ds = plugin_lookup_ds(vl->type)) == NULL)) {
     char ident[6 * DATA_MAX_NAME_LEN];
 
     FORMAT_VL(ident, sizeof(ident), vl);
@@ -2147,22 +5791,61 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
   escape_slashes(vl->type, sizeof(vl->type));
   escape_slashes(vl->type_instance, sizeof(vl->type_instance));
 
-  if (pre_cache_chain != NULL) {
+  pthread_rwlock_rdlock(&chain_lock);
+  status = 0;
+  if (pre_cache_chain != NULL)
     status = fc_process_chain(ds, vl, pre_cache_chain);
-    if (status < 0) {
-      WARNING("plugin_dispatch_values: Running the "
-              "pre-cache chain failed with "
-              "status %i (%#x).",
-              status, status);
-    } else if (status == FC_TARGET_STOP)
-      return 0;
+  pthread_rwlock_unlock(&chain_lock);
+  if (status < 0) {
+    WARNING("plugin_dispatch_values: Running the "
+            "pre-cache chain failed with "
+            "status %i (%#x).",
+            status, status);
+  } else if (status == FC_TARGET_STOP)
+    return 0;
+
+  /* Update the value cache. Unchanged values of plugins with
+   * "SuppressUnchanged" end here; the refreshed cache entry keeps them from
+   * being reported as missing. Once writers read rates, they are computed
+   * here and attached to the value list, so writers don't have to look them
+   * up again. */
+  gauge_t rates[DISPATCH_RATES_MAX];
+  gauge_t *ret_rates = NULL;
+  if ((ds->ds_num <= STATIC_ARRAY_SIZE(rates)) && uc_rates_wanted())
+    ret_rates = rates;
+
+  int suppress = plugin_get_ctx().suppress_unchanged;
+  status = uc_update_changed(ds, vl, suppress, ret_rates);
+  if ((suppress > 0) && (status == 1)) {
+    if (record_statistics)
+      __atomic_fetch_add(&stats_values_suppressed, 1, __ATOMIC_RELAXED);
+    if (free_meta_data && (vl->meta != NULL)) {
+      meta_data_destroy(vl->meta);
+      vl->meta = NULL;
+    }
+    return 0;
+  }
+  vl->rates = (status >= 0) ? ret_rates : NULL;
+
+  if ((filter_shards_num == 0) || (plugin_filter_enqueue(ds, vl) != 0))
+    plugin_dispatch_post_cache(ds, vl);
+
+  /* `rates' goes out of scope. */
+  vl->rates = NULL;
+
+  if ((free_meta_data == true) && (vl->meta != NULL)) {
+    meta_data_destroy(vl->meta);
+    vl->meta = NULL;
   }
 
-  /* Update the value cache */
-  uc_update(ds, vl);
+  return 0;
+} /* }}} int plugin_dispatch_values_internal */
 
+static void plugin_dispatch_post_cache(data_set_t const *ds, /* {{{ */
+                                       value_list_t *vl) {
+  pthread_rwlock_rdlock(&chain_lock);
   if (post_cache_chain != NULL) {
-    status = fc_process_chain(ds, vl, post_cache_chain);
+    int status = fc_process_chain(ds, vl, post_cache_chain);
     if (status < 0) {
       WARNING("plugin_dispatch_values: Running the "
               "post-cache chain failed with "
@@ -2171,35 +5854,33 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
     }
   } else
     fc_default_action(ds, vl);
+  pthread_rwlock_unlock(&chain_lock);
+} /* }}} void plugin_dispatch_post_cache */
 
-  if ((free_meta_data == true) && (vl->meta != NULL)) {
-    meta_data_destroy(vl->meta);
-    vl->meta = NULL;
-  }
+int plugin_reconfigure_chains(oconfig_item_t const *conf) /* {{{ */
+{
+  int ret = 0;
 
-  return 0;
-} /* int plugin_dispatch_values_internal */
+  pthread_rwlock_wrlock(&chain_lock);
 
-static double get_drop_probability(void) /* {{{ */
-{
-  long pos;
-  long size;
-  long wql;
+  pre_cache_chain = NULL;
+  post_cache_chain = NULL;
+  fc_free_all_chains();
 
-  pthread_mutex_lock(&write_lock);
-  wql = write_queue_length;
-  pthread_mutex_unlock(&write_lock);
+  for (int i = 0; i < conf->children_num; i++) {
+    oconfig_item_t const *ci = conf->children + i;
+    if ((ci->children != NULL) && (strcasecmp("Chain", ci->key) == 0))
+      if (fc_configure(ci) != 0)
+        ret = -1;
+  }
 
-  if (wql < write_limit_low)
-    return 0.0;
-  if (wql >= write_limit_high)
-    return 1.0;
+  pre_cache_chain = fc_chain_get_by_name(global_option_get("PreCacheChain"));
+  post_cache_chain = fc_chain_get_by_name(global_option_get("PostCacheChain"));
 
-  pos = 1 + wql - write_limit_low;
-  size = 1 + write_limit_high - write_limit_low;
+  pthread_rwlock_unlock(&chain_lock);
 
-  return (double)pos / (double)size;
-} /* }}} double get_drop_probability */
+  return ret;
+} /* }}} int plugin_reconfigure_chains */
 
 static bool check_drop_value(void) /* {{{ */
 {
@@ -2210,10 +5891,16 @@ static bool check_drop_value(void) /* {{{ */
   double q;
   int status;
 
-  if (write_limit_high == 0)
+  /* Value lists are spilled to the disk spool instead. */
+  if ((write_limit_high == 0) || (write_spool != NULL))
     return false;
 
-  p = get_drop_probability();
+  p = get_drop_probability(plugin_write_queue_length(), write_limit_low,
+                           write_limit_high);
+  /* Read callbacks are stretched instead, only the high water mark is a hard
+   * limit. */
+  if (write_queue_stretch && (p < 1.0))
+    return false;
   if (p == 0.0)
     return false;
 
@@ -2235,7 +5922,7 @@ static bool check_drop_value(void) /* {{{ */
     return true;
 
   q = cdrand_d();
-  if (q > p)
+  if (q < p)
     return true;
   else
     return false;
@@ -2244,7 +5931,9 @@ static bool check_drop_value(void) /* {{{ */
 EXPORT int plugin_dispatch_values(value_list_t const *vl) {
   int status;
 
+  CD_PROBE3(dispatch_values, vl->plugin, vl->type, 1);
   if (check_drop_value()) {
+    CD_PROBE2(dispatch_drop, vl->plugin, 1);
     if (record_statistics) {
       pthread_mutex_lock(&statistics_lock);
       stats_values_dropped++;
@@ -2264,94 +5953,207 @@ EXPORT int plugin_dispatch_values(value_list_t const *vl) {
   return 0;
 }
 
-__attribute__((sentinel)) int
-plugin_dispatch_multivalue(value_list_t const *template, /* {{{ */
-                           bool store_percentage, int store_type, ...) {
-  value_list_t *vl;
+EXPORT int
+plugin_dispatch_values_bulk(value_list_t const *vl_template, /* {{{ */
+                            char const *const *type_instances,
+                            value_t const *values, size_t num) {
+  queued_value_list_t **qvls;
+  data_set_t *ds = NULL;
+  size_t qvls_num = 0;
   int failed = 0;
-  gauge_t sum = 0.0;
-  va_list ap;
 
+  if ((vl_template == NULL) || (type_instances == NULL) || (values == NULL))
+    return -1;
+  if (num == 0)
+    return 0;
+
+  CD_PROBE3(dispatch_values, vl_template->plugin, vl_template->type, num);
   if (check_drop_value()) {
+    CD_PROBE2(dispatch_drop, vl_template->plugin, num);
     if (record_statistics) {
       pthread_mutex_lock(&statistics_lock);
-      stats_values_dropped++;
+      stats_values_dropped += (derive_t)num;
       pthread_mutex_unlock(&statistics_lock);
     }
     return 0;
   }
 
-  assert(template->values_len == 1);
+  qvls = calloc(num, sizeof(*qvls));
+  if (qvls == NULL) {
+    ERROR("plugin_dispatch_values_bulk: calloc failed.");
+    return (int)num;
+  }
 
-  /* Calculate sum for Gauge to calculate percent if needed */
-  if (DS_TYPE_GAUGE == store_type) {
-    va_start(ap, store_type);
-    while (42) {
-      char const *name;
-      gauge_t value;
+  /* Looked up once for the whole group. If the type is unknown, the write
+   * thread will report it. */
+  ds = plugin_lookup_ds(vl_template->type);
 
-      name = va_arg(ap, char const *);
-      if (name == NULL)
-        break;
+  /* All value lists of the group share the time stamp. */
+  value_list_t vl = *vl_template;
+  if (vl.time == 0)
+    vl.time = cdtime_cached();
+
+  for (size_t i = 0; i < num; i++) {
+    sstrncpy(vl.type_instance, type_instances[i], sizeof(vl.type_instance));
+    vl.values = (value_t *)values + i * vl_template->values_len;
 
-      value = va_arg(ap, gauge_t);
-      if (!isnan(value))
-        sum += value;
+    qvls[qvls_num] = queued_value_list_create(&vl);
+    if (qvls[qvls_num] == NULL) {
+      failed++;
+      continue;
     }
-    va_end(ap);
+    qvls_num++;
   }
 
-  vl = plugin_value_list_clone(template);
-  /* plugin_value_list_clone makes sure vl->time is set to non-zero. */
-  if (store_percentage)
-    sstrncpy(vl->type, "percent", sizeof(vl->type));
+  int status = plugin_write_enqueue_qvls(qvls, qvls_num, ds);
+  if (status != 0) {
+    ERROR("plugin_dispatch_values_bulk: plugin_write_enqueue_qvls failed "
+          "with status %i (%s).",
+          status, STRERROR(status));
+    failed = (int)num;
+  }
 
-  va_start(ap, store_type);
-  while (42) {
-    char const *name;
-    int status;
+  sfree(qvls);
+  return failed;
+} /* }}} int plugin_dispatch_values_bulk */
 
-    /* Set the type instance. */
-    name = va_arg(ap, char const *);
-    if (name == NULL)
-      break;
-    sstrncpy(vl->type_instance, name, sizeof(vl->type_instance));
-
-    /* Set the value. */
-    switch (store_type) {
-    case DS_TYPE_GAUGE:
-      vl->values[0].gauge = va_arg(ap, gauge_t);
-      if (store_percentage)
-        vl->values[0].gauge *= sum ? (100.0 / sum) : NAN;
-      break;
-    case DS_TYPE_ABSOLUTE:
-      vl->values[0].absolute = va_arg(ap, absolute_t);
-      break;
-    case DS_TYPE_COUNTER:
-      vl->values[0].counter = va_arg(ap, counter_t);
-      break;
-    case DS_TYPE_DERIVE:
-      vl->values[0].derive = va_arg(ap, derive_t);
-      break;
-    default:
-      ERROR("plugin_dispatch_multivalue: given store_type is incorrect.");
-      failed++;
+EXPORT int plugin_dispatch_value_lists(value_list_t const *vls, /* {{{ */
+                                       size_t num) {
+  queued_value_list_t **qvls;
+  size_t qvls_num = 0;
+  int failed = 0;
+
+  if (vls == NULL)
+    return -1;
+  if (num == 0)
+    return 0;
+
+  /* The first value list stands for the batch. */
+  CD_PROBE3(dispatch_values, vls->plugin, vls->type, num);
+  if (check_drop_value()) {
+    CD_PROBE2(dispatch_drop, vls->plugin, num);
+    if (record_statistics) {
+      pthread_mutex_lock(&statistics_lock);
+      stats_values_dropped += (derive_t)num;
+      pthread_mutex_unlock(&statistics_lock);
     }
+    return 0;
+  }
 
-    status = plugin_write_enqueue(vl);
-    if (status != 0)
+  qvls = calloc(num, sizeof(*qvls));
+  if (qvls == NULL) {
+    ERROR("plugin_dispatch_value_lists: calloc failed.");
+    return (int)num;
+  }
+
+  /* Value lists without a time stamp share one for the whole batch. */
+  cdtime_t old_cache = cdtime_cache_set(cdtime_cached());
+  for (size_t i = 0; i < num; i++) {
+    qvls[qvls_num] = queued_value_list_create(vls + i);
+    if (qvls[qvls_num] == NULL) {
       failed++;
+      continue;
+    }
+    qvls_num++;
+  }
+  cdtime_cache_set(old_cache);
+
+  /* The value lists may have different types, so the write thread looks up
+   * the data sets. */
+  int status = plugin_write_enqueue_qvls(qvls, qvls_num, /* ds = */ NULL);
+  if (status != 0) {
+    ERROR("plugin_dispatch_value_lists: plugin_write_enqueue_qvls failed "
+          "with status %i (%s).",
+          status, STRERROR(status));
+    failed = (int)num;
+  }
+
+  sfree(qvls);
+  return failed;
+} /* }}} int plugin_dispatch_value_lists */
+
+/* Reads one value of type `store_type' from `ap'. */
+#define MULTIVALUE_VA_ARG(ap, store_type, value)                               \
+  do {                                                                         \
+    switch (store_type) {                                                      \
+    case DS_TYPE_GAUGE:                                                        \
+      (value).gauge = va_arg(ap, gauge_t);                                     \
+      break;                                                                   \
+    case DS_TYPE_ABSOLUTE:                                                     \
+      (value).absolute = va_arg(ap, absolute_t);                               \
+      break;                                                                   \
+    case DS_TYPE_COUNTER:                                                      \
+      (value).counter = va_arg(ap, counter_t);                                 \
+      break;                                                                   \
+    case DS_TYPE_DERIVE:                                                       \
+      (value).derive = va_arg(ap, derive_t);                                   \
+      break;                                                                   \
+    }                                                                          \
+  } while (0)
+
+__attribute__((sentinel)) int
+plugin_dispatch_multivalue(value_list_t const *template, /* {{{ */
+                           bool store_percentage, int store_type, ...) {
+  char const **type_instances;
+  value_t *values;
+  size_t num = 0;
+  int failed;
+  gauge_t sum = 0.0;
+  va_list ap;
+
+  assert(template->values_len == 1);
+
+  if ((store_type != DS_TYPE_GAUGE) && (store_type != DS_TYPE_ABSOLUTE) &&
+      (store_type != DS_TYPE_COUNTER) && (store_type != DS_TYPE_DERIVE)) {
+    ERROR("plugin_dispatch_multivalue: given store_type is incorrect.");
+    return -1;
+  }
+
+  /* Count the values and calculate the sum for Gauge to calculate percent if
+   * needed */
+  va_start(ap, store_type);
+  while (va_arg(ap, char const *) != NULL) {
+    value_t value;
+    MULTIVALUE_VA_ARG(ap, store_type, value);
+    if ((store_type == DS_TYPE_GAUGE) && !isnan(value.gauge))
+      sum += value.gauge;
+    num++;
+  }
+  va_end(ap);
+
+  if (num == 0)
+    return 0;
+
+  type_instances = calloc(num, sizeof(*type_instances));
+  values = calloc(num, sizeof(*values));
+  if ((type_instances == NULL) || (values == NULL)) {
+    ERROR("plugin_dispatch_multivalue: calloc failed.");
+    free(type_instances);
+    free(values);
+    return (int)num;
+  }
+
+  va_start(ap, store_type);
+  for (size_t i = 0; i < num; i++) {
+    type_instances[i] = va_arg(ap, char const *);
+    MULTIVALUE_VA_ARG(ap, store_type, values[i]);
+    if (store_percentage)
+      values[i].gauge *= sum ? (100.0 / sum) : NAN;
   }
   va_end(ap);
 
-  plugin_value_list_free(vl);
+  value_list_t vl = *template;
+  if (store_percentage)
+    sstrncpy(vl.type, "percent", sizeof(vl.type));
+
+  failed = plugin_dispatch_values_bulk(&vl, type_instances, values, num);
+
+  free(type_instances);
+  free(values);
   return failed;
 } /* }}} int plugin_dispatch_multivalue */
 
 EXPORT int plugin_dispatch_notification(const notification_t *notif) {
-  llentry_t *le;
-  /* Possible TODO: Add flap detection here */
-
   DEBUG("plugin_dispatch_notification: severity = %i; message = %s; "
         "time = %.3f; host = %s;",
         notif->severity, notif->message, CDTIME_T_TO_DOUBLE(notif->time),
@@ -2361,27 +6163,13 @@ EXPORT int plugin_dispatch_notification(const notification_t *notif) {
   if (list_notification == NULL)
     return -1;
 
-  le = llist_head(list_notification);
-  while (le != NULL) {
-    callback_func_t *cf;
-    plugin_notification_cb callback;
-    int status;
-
-    /* do not switch plugin context; rather keep the context
-     * (interval) information of the calling plugin */
-
-    cf = le->value;
-    callback = cf->cf_callback;
-    status = (*callback)(notif, &cf->cf_udata);
-    if (status != 0) {
-      WARNING("plugin_dispatch_notification: Notification "
-              "callback %s returned %i.",
-              le->key, status);
-    }
-
-    le = le->next;
+  if (notif_threads != NULL) {
+    int status = plugin_notification_enqueue(notif);
+    if (status != EAGAIN)
+      return status;
   }
 
+  plugin_notification_run_callbacks(notif);
   return 0;
 } /* int plugin_dispatch_notification */
 
@@ -2475,12 +6263,13 @@ EXPORT int parse_notif_severity(const char *severity) {
 EXPORT const data_set_t *plugin_get_ds(const char *name) {
   data_set_t *ds;
 
-  if (data_sets == NULL) {
+  if (ds_entries_num == 0) {
     P_ERROR("plugin_get_ds: No data sets are defined yet.");
     return NULL;
   }
 
-  if (c_avl_get(data_sets, name, (void *)&ds) != 0) {
+  ds = plugin_lookup_ds(name);
+  if (ds == NULL) {
     DEBUG("No such dataset registered: %s", name);
     return NULL;
   }
@@ -2488,6 +6277,30 @@ EXPORT const data_set_t *plugin_get_ds(const char *name) {
   return ds;
 } /* data_set_t *plugin_get_ds */
 
+EXPORT ds_handle_t plugin_get_ds_handle(const char *name) {
+  data_set_entry_t *e;
+
+  if ((name == NULL) || ((e = plugin_find_ds_entry(name)) == NULL) ||
+      (e->ds == NULL))
+    return DS_HANDLE_INVALID;
+
+  return e->handle;
+} /* ds_handle_t plugin_get_ds_handle */
+
+EXPORT const data_set_t *plugin_get_ds_by_handle(ds_handle_t handle) {
+  if ((handle < 0) || ((size_t)handle >= ds_entries_num))
+    return NULL;
+
+  return ds_entries[handle]->ds;
+} /* data_set_t *plugin_get_ds_by_handle */
+
+EXPORT const ds_plan_t *plugin_get_ds_plan_by_handle(ds_handle_t handle) {
+  if ((handle < 0) || ((size_t)handle >= ds_entries_num))
+    return NULL;
+
+  return ds_entries[handle]->plan;
+} /* ds_plan_t *plugin_get_ds_plan_by_handle */
+
 static int plugin_notification_meta_add(notification_t *n, const char *name,
                                         enum notification_meta_type_e type,
                                         const void *value) {
@@ -2752,5 +6565,16 @@ int plugin_thread_create(pthread_t *thread, void *(*start_routine)(void *),
   if (name != NULL)
     set_thread_name(*thread, name);
 
+  char const *cpus = plugin_get_ctx().thread_cpus;
+  if (cpus != NULL) {
+    core_groups_list_t cgl = {0};
+    if (thread_cpus_parse("ThreadCPUs", cpus, &cgl) == 0)
+      thread_cpus_apply(*thread, &cgl,
+                        __atomic_fetch_add(&plugin_thread_cpus_next, 1,
+                                           __ATOMIC_RELAXED),
+                        (name != NULL) ? name : "(unnamed)");
+    config_cores_cleanup(&cgl);
+  }
+
   return 0;
 } /* int plugin_thread_create */
@@ -111,11 +111,15 @@ struct value_list_s {
   char type[DATA_MAX_NAME_LEN];
   char type_instance[DATA_MAX_NAME_LEN];
   meta_data_t *meta;
+  /* Rates computed by the value cache when the values were dispatched, or
+   * NULL. Set by the daemon for write callbacks; use uc_get_rate_attached()
+   * to read them. */
+  gauge_t const *rates;
 };
 typedef struct value_list_s value_list_t;
 
 #define VALUE_LIST_INIT                                                        \
-  { .values = NULL, .meta = NULL }
+  { .values = NULL, .meta = NULL, .rates = NULL }
 
 struct data_source_s {
   char name[DATA_MAX_NAME_LEN];
@@ -185,6 +189,27 @@ struct plugin_ctx_s {
   cdtime_t interval;
   cdtime_t flush_interval;
   cdtime_t flush_timeout;
+  /* Private write queue of write plugins; see "WriteThreads" et al. in the
+   * <LoadPlugin> block. Zero threads means the writer is called directly from
+   * the global write threads. */
+  int write_threads;
+  int write_limit_high;
+  int write_limit_low;
+  bool write_queue_block;
+  /* Write plugins only get one consolidated value per series and window of
+   * this length; see "Resolution" in the <LoadPlugin> block. The function is
+   * a write_resolution_function_t. */
+  cdtime_t write_resolution;
+  int write_resolution_function;
+  /* Number of consecutive intervals an unchanged value is kept from the
+   * writers; see "SuppressUnchanged" in the <LoadPlugin> block. */
+  int suppress_unchanged;
+  /* Read callbacks with a priority above zero are not stretched when the
+   * write queue is overloaded; see "Priority" in the <LoadPlugin> block. */
+  int priority;
+  /* CPUs the threads started by the plugin with plugin_thread_create() are
+   * pinned to; see "ThreadCPUs" in the <LoadPlugin> block. */
+  char *thread_cpus;
 };
 typedef struct plugin_ctx_s plugin_ctx_t;
 
@@ -193,8 +218,22 @@ typedef struct plugin_ctx_s plugin_ctx_t;
  */
 typedef int (*plugin_init_cb)(void);
 typedef int (*plugin_read_cb)(user_data_t *);
+/* "read group" callback. Called with the user data of several read callbacks
+ * of one group at once, see plugin_register_read_group(). Stores the status of
+ * each read in "status", which is initialized to zero. A non-zero return value
+ * marks all reads without a status of their own as failed. */
+typedef int (*plugin_read_group_cb)(user_data_t *const *user_data, int *status,
+                                    size_t num);
 typedef int (*plugin_write_cb)(const data_set_t *, const value_list_t *,
                                user_data_t *);
+typedef struct {
+  const data_set_t *ds;
+  const value_list_t *vl;
+} write_batch_entry_t;
+/* "write batch" callback. Called with up to "batch_size" value lists at once,
+ * see plugin_register_write_batch(). */
+typedef int (*plugin_write_batch_cb)(write_batch_entry_t const *entries,
+                                     size_t entries_num, user_data_t *);
 typedef int (*plugin_flush_cb)(cdtime_t timeout, const char *identifier,
                                user_data_t *);
 /* "missing" callback. Returns less than zero on failure, zero if other
@@ -250,9 +289,16 @@ int plugin_load(const char *name, bool global);
 bool plugin_is_loaded(char const *name);
 
 int plugin_init_all(void);
+int plugin_init_plugin(char const *name);
 void plugin_read_all(void);
 int plugin_read_all_once(void);
+/* Runs every read callback `iterations' times, up to `threads' of them at a
+ * time, then hands `iterations' synthetic value lists to every write callback
+ * and prints the cost per call. Used by the `-b' command line option. */
+int plugin_bench_all(size_t iterations, size_t threads);
 int plugin_shutdown_all(void);
+/* Replaces the filter chains with the "Chain" blocks of "conf". */
+int plugin_reconfigure_chains(oconfig_item_t const *conf);
 
 /*
  * NAME
@@ -284,6 +330,29 @@ int plugin_shutdown_all(void);
 int plugin_write(const char *plugin, const data_set_t *ds,
                  const value_list_t *vl);
 
+/*
+ * NAME
+ *  plugin_write_handle
+ *
+ * DESCRIPTION
+ *  Looks up the write callback called `name' for use with plugin_write_to().
+ *  The handle follows the callbacks registered and unregistered under that
+ *  name, so it may be obtained before the callback is registered, e.g. while
+ *  parsing the configuration. Names are compared case-insensitively.
+ *
+ * RETURN VALUE
+ *  The handle, which is never freed, or NULL on allocation failure.
+ */
+typedef struct plugin_write_handle_s plugin_write_handle_t;
+plugin_write_handle_t *plugin_write_handle(char const *name);
+
+/* Like plugin_write() with a plugin name, but without looking the callback up
+ * on every call. Values go through the writer's private queue if it has one.
+ * Returns ENOENT if no callback is currently registered under the handle's
+ * name. */
+int plugin_write_to(plugin_write_handle_t *h, const data_set_t *ds,
+                    const value_list_t *vl);
+
 int plugin_flush(const char *plugin, cdtime_t timeout, const char *identifier);
 
 /*
@@ -296,15 +365,46 @@ int plugin_register_config(const char *name,
                            const char **keys, int keys_num);
 int plugin_register_complex_config(const char *type,
                                    int (*callback)(oconfig_item_t *));
+/* Lets the plugin `type' be reconfigured when the configuration is reloaded.
+ * If its configuration changed, "callback" is called first and has to drop
+ * all state created by the previous configuration, including read callbacks
+ * registered by the config callback. Then the new "Plugin" blocks are passed
+ * to the callback registered with "plugin_register_complex_config" again. */
+int plugin_register_reconfigure(const char *type, int (*callback)(void));
 int plugin_register_init(const char *name, plugin_init_cb callback);
+/* Like "plugin_register_init", but if the "InitThreads" global option is
+ * greater than one, "callback" may run on another thread, concurrently with
+ * the init callbacks of other plugins registered this way. It still runs after
+ * the init callbacks of all plugins loaded before it that were registered with
+ * "plugin_register_init". "depends_on" is NULL or a comma separated list of
+ * init callback names which have to complete before "callback" is called. */
+int plugin_register_init_concurrent(const char *name, plugin_init_cb callback,
+                                    const char *depends_on);
 int plugin_register_read(const char *name, int (*callback)(void));
 /* "user_data" will be freed automatically, unless
  * "plugin_register_complex_read" returns an error (non-zero). */
 int plugin_register_complex_read(const char *group, const char *name,
                                  plugin_read_cb callback, cdtime_t interval,
                                  user_data_t const *user_data);
+/* Opt-in batching of the complex read callbacks registered with "group":
+ * callbacks of the group that are due within "window" of each other are
+ * passed to "callback" together instead of being called one by one, so the
+ * plugin can issue their requests concurrently and take shared locks once.
+ * The individual callbacks are still used when only one of them is due. Zero
+ * selects the default window, a tenth of the plugin's interval.
+ * "plugin_unregister_read_group" removes the batch callback, too. */
+int plugin_register_read_group(const char *group,
+                               plugin_read_group_cb callback, cdtime_t window);
 int plugin_register_write(const char *name, plugin_write_cb callback,
                           user_data_t const *user_data);
+/* Like "plugin_register_write", but the daemon queues value lists for this
+ * writer and passes them to "callback" once "batch_size" value lists have
+ * accumulated or the oldest one is "max_age" old, whichever is first. Zero
+ * selects the default for either limit (512 value lists, one second). */
+int plugin_register_write_batch(const char *name,
+                                plugin_write_batch_cb callback,
+                                size_t batch_size, cdtime_t max_age,
+                                user_data_t const *user_data);
 int plugin_register_flush(const char *name, plugin_flush_cb callback,
                           user_data_t const *user_data);
 int plugin_register_missing(const char *name, plugin_missing_cb callback,
@@ -325,6 +425,8 @@ int plugin_unregister_complex_config(const char *name);
 int plugin_unregister_init(const char *name);
 int plugin_unregister_read(const char *name);
 int plugin_unregister_read_group(const char *group);
+/* Unregisters all read callbacks registered by the plugin "plugin". */
+int plugin_unregister_read_plugin(const char *plugin);
 int plugin_unregister_write(const char *name);
 int plugin_unregister_flush(const char *name);
 int plugin_unregister_missing(const char *name);
@@ -362,6 +464,45 @@ void plugin_log_available_writers(void);
  */
 int plugin_dispatch_values(value_list_t const *vl);
 
+/*
+ * NAME
+ *  plugin_dispatch_values_bulk
+ *
+ * SYNOPSIS
+ *  char const *type_instances[] = {"user", "system", "idle"};
+ *  value_t values[] = {{.derive = 42}, {.derive = 23}, {.derive = 666}};
+ *  plugin_dispatch_values_bulk(&vl, type_instances, values, 3);
+ *
+ * DESCRIPTION
+ *  Dispatches `num' value lists which only differ in the type instance and
+ *  the values. All other fields are taken from `vl_template'. Value list `i'
+ *  has the type instance `type_instances[i]' and the
+ *  `vl_template->values_len' values starting at
+ *  `values + i * vl_template->values_len'. All value lists get the same time
+ *  stamp. The data set is looked up once and the group is added to
+ *  the write queue in one go.
+ *
+ * RETURNS
+ *  The number of value lists it failed to dispatch (zero on success).
+ */
+int plugin_dispatch_values_bulk(value_list_t const *vl_template,
+                                char const *const *type_instances,
+                                value_t const *values, size_t num);
+
+/*
+ * NAME
+ *  plugin_dispatch_value_lists
+ *
+ * DESCRIPTION
+ *  Dispatches the `num' value lists `vls[0..num)', which may differ in any
+ *  field. The group is added to the write queue in one go, which is cheaper
+ *  than calling `plugin_dispatch_values' for each of them.
+ *
+ * RETURNS
+ *  The number of value lists it failed to dispatch (zero on success).
+ */
+int plugin_dispatch_value_lists(value_list_t const *vls, size_t num);
+
 /*
  * NAME
  *  plugin_dispatch_multivalue
@@ -433,6 +574,35 @@ void daemon_log(int level, const char *format, ...)
 
 const data_set_t *plugin_get_ds(const char *name);
 
+/*
+ * Data set handles
+ *
+ * Every registered type gets a small integer handle, in the order in which
+ * the types are registered (i.e. the order of the types.db files). A type
+ * keeps its handle for the lifetime of the process, even if it is replaced.
+ * Plugins that dispatch or handle the same types over and over can resolve
+ * the handle once, e.g. in their init callback, and use
+ * plugin_get_ds_by_handle() instead of looking the type up by name.
+ *
+ * Data sets must not be registered concurrently with these functions, i.e.
+ * they are safe to use once the configuration has been read.
+ */
+typedef int ds_handle_t;
+#define DS_HANDLE_INVALID (-1)
+
+/* Returns the handle of the type `name', or DS_HANDLE_INVALID. */
+ds_handle_t plugin_get_ds_handle(const char *name);
+
+/* Returns the data set of `handle', or NULL if the handle is invalid or the
+ * type has been unregistered. */
+const data_set_t *plugin_get_ds_by_handle(ds_handle_t handle);
+
+/* Returns the conversion plan of the data set of `handle', created when the
+ * type was registered, or NULL like plugin_get_ds_by_handle(). See ds_plan_t
+ * in "utils/common/common.h". */
+struct ds_plan_s;
+const struct ds_plan_s *plugin_get_ds_plan_by_handle(ds_handle_t handle);
+
 int plugin_notification_meta_add_string(notification_t *n, const char *name,
                                         const char *value);
 int plugin_notification_meta_add_signed_int(notification_t *n, const char *name,
@@ -25,6 +25,7 @@
  */
 
 #include "plugin.h"
+#include "utils/common/common.h"
 
 #if HAVE_KSTAT_H
 #include <kstat.h>
@@ -39,9 +40,28 @@ char *hostname_g = "example.com";
 void plugin_set_dir(const char *dir) { /* nop */
 }
 
-int plugin_load(const char *name, bool global) { return ENOTSUP; }
+/* The following are weak, so that tests of the configuration handling can
+ * track which plugins are loaded. */
+__attribute__((weak)) int plugin_load(const char *name, bool global) {
+  return ENOTSUP;
+}
+
+__attribute__((weak)) bool plugin_is_loaded(const char *name) {
+  return false;
+}
 
-bool plugin_is_loaded(const char *name) { return false; }
+__attribute__((weak)) int plugin_init_plugin(char const *name) {
+  return ENOTSUP;
+}
+
+__attribute__((weak)) int
+plugin_reconfigure_chains(oconfig_item_t const *conf) {
+  return ENOTSUP;
+}
+
+__attribute__((weak)) int plugin_unregister_read_plugin(const char *plugin) {
+  return ENOTSUP;
+}
 
 int plugin_register_config(const char *name,
                            int (*callback)(const char *key, const char *val),
@@ -54,10 +74,19 @@ int plugin_register_complex_config(const char *type,
   return ENOTSUP;
 }
 
+int plugin_register_reconfigure(const char *type, int (*callback)(void)) {
+  return ENOTSUP;
+}
+
 int plugin_register_init(const char *name, plugin_init_cb callback) {
   return ENOTSUP;
 }
 
+int plugin_register_init_concurrent(const char *name, plugin_init_cb callback,
+                                    const char *depends_on) {
+  return ENOTSUP;
+}
+
 int plugin_register_read(__attribute__((unused)) const char *name,
                          __attribute__((unused)) int (*callback)(void)) {
   return ENOTSUP;
@@ -69,6 +98,15 @@ int plugin_register_write(__attribute__((unused)) const char *name,
   return ENOTSUP;
 }
 
+int plugin_register_write_batch(
+    __attribute__((unused)) const char *name,
+    __attribute__((unused)) plugin_write_batch_cb callback,
+    __attribute__((unused)) size_t batch_size,
+    __attribute__((unused)) cdtime_t max_age,
+    __attribute__((unused)) user_data_t const *ud) {
+  return ENOTSUP;
+}
+
 int plugin_register_flush(__attribute__((unused)) const char *name,
                           __attribute__((unused)) plugin_flush_cb callback,
                           __attribute__((unused))
@@ -81,6 +119,13 @@ int plugin_register_missing(const char *name, plugin_missing_cb callback,
   return ENOTSUP;
 }
 
+int plugin_register_cache_event(__attribute__((unused)) const char *name,
+                                __attribute__((unused))
+                                plugin_cache_event_cb callback,
+                                __attribute__((unused)) user_data_t const *ud) {
+  return ENOTSUP;
+}
+
 int plugin_register_complex_read(const char *group, const char *name,
                                  int (*callback)(user_data_t *),
                                  cdtime_t interval,
@@ -88,11 +133,32 @@ int plugin_register_complex_read(const char *group, const char *name,
   return ENOTSUP;
 }
 
+int plugin_register_read_group(const char *group,
+                               plugin_read_group_cb callback, cdtime_t window) {
+  return ENOTSUP;
+}
+
 int plugin_register_shutdown(const char *name, int (*callback)(void)) {
   return ENOTSUP;
 }
 
-int plugin_register_data_set(const data_set_t *ds) { return ENOTSUP; }
+/* Data sets registered by the test. They are not copied, so they must stay
+ * valid. */
+#define MOCK_DATA_SETS_MAX 16
+static const data_set_t *mock_data_sets[MOCK_DATA_SETS_MAX];
+static ds_plan_t *mock_plans[MOCK_DATA_SETS_MAX];
+static size_t mock_data_sets_num;
+
+int plugin_register_data_set(const data_set_t *ds) {
+  if (mock_data_sets_num >= MOCK_DATA_SETS_MAX)
+    return ENOMEM;
+  mock_plans[mock_data_sets_num] = ds_plan_create(ds);
+  if (mock_plans[mock_data_sets_num] == NULL)
+    return EINVAL;
+  mock_data_sets[mock_data_sets_num] = ds;
+  mock_data_sets_num++;
+  return 0;
+}
 
 int plugin_register_notification(__attribute__((unused)) const char *name,
                                  __attribute__((unused))
@@ -114,6 +180,7 @@ DECLARE_UNREGISTER(read_group)
 DECLARE_UNREGISTER(write)
 DECLARE_UNREGISTER(flush)
 DECLARE_UNREGISTER(missing)
+DECLARE_UNREGISTER(cache_event)
 DECLARE_UNREGISTER(shutdown)
 DECLARE_UNREGISTER(data_set)
 DECLARE_UNREGISTER(log)
@@ -121,6 +188,17 @@ DECLARE_UNREGISTER(notification)
 
 int plugin_dispatch_values(value_list_t const *vl) { return ENOTSUP; }
 
+int plugin_dispatch_missing(__attribute__((unused)) const value_list_t *vl) {
+  return 0;
+}
+
+void plugin_dispatch_cache_event(
+    __attribute__((unused)) enum cache_event_type_e event_type,
+    __attribute__((unused)) unsigned long callbacks_mask,
+    __attribute__((unused)) const char *name,
+    __attribute__((unused)) const value_list_t *vl) { /* nop */
+}
+
 int plugin_dispatch_notification(__attribute__((unused))
                                  const notification_t *notif) {
   return ENOTSUP;
@@ -184,16 +262,67 @@ int plugin_flush(const char *plugin, cdtime_t timeout, const char *identifier) {
   return ENOTSUP;
 }
 
+int plugin_write(__attribute__((unused)) const char *plugin,
+                 __attribute__((unused)) const data_set_t *ds,
+                 __attribute__((unused)) const value_list_t *vl) {
+  return ENOTSUP;
+}
+
+plugin_write_handle_t *plugin_write_handle(__attribute__((unused))
+                                           char const *name) {
+  return NULL;
+}
+
+int plugin_write_to(__attribute__((unused)) plugin_write_handle_t *h,
+                    __attribute__((unused)) const data_set_t *ds,
+                    __attribute__((unused)) const value_list_t *vl) {
+  return ENOTSUP;
+}
+
+void plugin_log_available_writers(void) { /* nop */
+}
+
 static data_source_t magic_ds[] = {{"value", DS_TYPE_DERIVE, 0.0, NAN}};
 static data_set_t magic = {"MAGIC", 1, magic_ds};
-const data_set_t *plugin_get_ds(const char *name) {
-  if (strcmp(name, "MAGIC"))
+
+/* Handle 0 is "MAGIC", registered data sets follow. */
+ds_handle_t plugin_get_ds_handle(const char *name) {
+  if (strcmp(name, "MAGIC") == 0)
+    return 0;
+
+  for (size_t i = 0; i < mock_data_sets_num; i++)
+    if (strcmp(name, mock_data_sets[i]->type) == 0)
+      return (ds_handle_t)(i + 1);
+
+  return DS_HANDLE_INVALID;
+}
+
+const data_set_t *plugin_get_ds_by_handle(ds_handle_t handle) {
+  if (handle == 0)
+    return &magic;
+  if ((handle < 0) || ((size_t)handle > mock_data_sets_num))
+    return NULL;
+  return mock_data_sets[handle - 1];
+}
+
+const ds_plan_t *plugin_get_ds_plan_by_handle(ds_handle_t handle) {
+  static ds_plan_t *magic_plan;
+
+  if (handle == 0) {
+    if (magic_plan == NULL)
+      magic_plan = ds_plan_create(&magic);
+    return magic_plan;
+  }
+  if ((handle < 0) || ((size_t)handle > mock_data_sets_num))
     return NULL;
+  return mock_plans[handle - 1];
+}
 
-  return &magic;
+const data_set_t *plugin_get_ds(const char *name) {
+  return plugin_get_ds_by_handle(plugin_get_ds_handle(name));
 }
 
-void plugin_log(int level, char const *format, ...) {
+__attribute__((weak)) void plugin_log(int level, char const *format, ...) {
   char buffer[1024];
   va_list ap;
 
@@ -242,5 +371,8 @@ int plugin_thread_create(__attribute__((unused)) pthread_t *thread,
 /* TODO(octo): this function is actually from filter_chain.h, but in order not
  * to tumble down that rabbit hole, we're declaring it here. A better solution
  * would be to hard-code the top-level config keys in daemon/collectd.c to avoid
- * having these references in daemon/configfile.c. */
-int fc_configure(const oconfig_item_t *ci) { return ENOTSUP; }
+ * having these references in daemon/configfile.c. Weak, so that tests of the
+ * filter chains can link the real one. */
+__attribute__((weak)) int fc_configure(const oconfig_item_t *ci) {
+  return ENOTSUP;
+}
@@ -0,0 +1,79 @@
+/**
+ * collectd - src/daemon/probes.h
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef PROBES_H
+#define PROBES_H 1
+
+/*
+ * Statically defined tracepoints (USDT) of the "collectd" provider. With
+ * <sys/sdt.h> (SystemTap, also used by bpftrace and perf) each probe is a
+ * single nop until a tracer attaches; without it the probes are compiled out.
+ * With <sys/sdt.h> the arguments are evaluated even when no tracer is
+ * attached, so they should be cheap and must not have side effects.
+ *
+ *   dispatch_values(plugin, type, num)   entry of plugin_dispatch_values*()
+ *   dispatch_drop(plugin, num)           values dropped by WriteQueueLimit*
+ *   write_enqueue(qvl)                   value list appended to write queue
+ *   write_dequeue(qvl, plugin, type)     value list taken by a write thread
+ *   filter_rule_match(chain, rule, plugin, type)
+ *                                        all matches of a rule matched
+ *   cache_update(plugin, type, time)     value list entering the cache
+ *   read_start(name)                     read callback called
+ *   read_end(name, status, elapsed)      read callback returned
+ *   network_receive(packet, size)        packet received by the network plugin
+ *   network_parse_start(packet, size)    network plugin starts parsing it
+ *   network_parse_end(packet, values)    parsing done, values dispatched
+ *
+ * `qvl' and `packet' are opaque pointers that identify the same item in
+ * related probes, e.g. to measure how long a value list stays queued:
+ *
+ *   bpftrace -e 'usdt:collectd:write_enqueue { @t[arg0] = nsecs; }
+ *     usdt:collectd:write_dequeue /@t[arg0]/ {
+ *       @us = hist((nsecs - @t[arg0]) / 1000); delete(@t[arg0]); }'
+ *
+ * Times are cdtime_t values.
+ */
+
+#if HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+
+#define CD_PROBE1(name, a) DTRACE_PROBE1(collectd, name, a)
+#define CD_PROBE2(name, a, b) DTRACE_PROBE2(collectd, name, a, b)
+#define CD_PROBE3(name, a, b, c) DTRACE_PROBE3(collectd, name, a, b, c)
+#define CD_PROBE4(name, a, b, c, d) DTRACE_PROBE4(collectd, name, a, b, c, d)
+#else
+#define CD_PROBE1(name, a)                                                     \
+  do {                                                                         \
+  } while (0)
+#define CD_PROBE2(name, a, b)                                                  \
+  do {                                                                         \
+  } while (0)
+#define CD_PROBE3(name, a, b, c)                                               \
+  do {                                                                         \
+  } while (0)
+#define CD_PROBE4(name, a, b, c, d)                                            \
+  do {                                                                         \
+  } while (0)
+#endif
+
+#endif /* PROBES_H */
@@ -32,6 +32,45 @@
 #include "plugin.h"
 #include "types_list.h"
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Compiled types databases (see the "TypesDBCache" option) start with this
+ * header, followed by "sets_num" set records and "sources_num" data sources.
+ * The file is only read by the daemon that wrote it, so it uses the host's
+ * byte order and struct layout; the layout is recorded in the header and
+ * checked when loading. The stat(2) information of the source file decides
+ * whether the compiled file is still current. */
+#define TYPES_CACHE_MAGIC "cdtypes"
+#define TYPES_CACHE_VERSION 1
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t name_len;    /* DATA_MAX_NAME_LEN */
+  uint32_t source_size; /* sizeof(data_source_t) */
+  uint32_t set_size;    /* sizeof(types_cache_set_t) */
+  uint32_t sets_num;
+  uint32_t sources_num;
+  uint64_t src_dev;
+  uint64_t src_ino;
+  uint64_t src_size;
+  int64_t src_mtime;
+} types_cache_header_t;
+
+typedef struct {
+  char type[DATA_MAX_NAME_LEN];
+  /* Data sources "ds_offset" to "ds_offset + ds_num - 1" belong to this set. */
+  uint32_t ds_offset;
+  uint32_t ds_num;
+} types_cache_set_t;
+
+/* Data sets read from one file, in the order they appear in it. */
+typedef struct {
+  data_set_t *sets;
+  size_t sets_num;
+} types_list_t;
+
 static int parse_ds(data_source_t *dsrc, char *buf, size_t buf_len) {
   char *dummy;
   char *saveptr;
@@ -93,7 +132,7 @@ static int parse_ds(data_source_t *dsrc, char *buf, size_t buf_len) {
   return 0;
 } /* int parse_ds */
 
-static void parse_line(char *buf) {
+static void parse_line(types_list_t *tl, char *buf) {
   char *fields[64];
   size_t fields_num;
   fields_num = strsplit(buf, fields, 64);
@@ -122,12 +161,18 @@ static void parse_line(char *buf) {
       return;
     }
 
-  plugin_register_data_set(&ds);
-
-  sfree(ds.ds);
+  data_set_t *tmp = realloc(tl->sets, (tl->sets_num + 1) * sizeof(*tl->sets));
+  if (tmp == NULL) {
+    ERROR("types_list: parse_line: realloc failed.");
+    sfree(ds.ds);
+    return;
+  }
+  tl->sets = tmp;
+  tl->sets[tl->sets_num] = ds;
+  tl->sets_num++;
 } /* void parse_line */
 
-static void parse_file(FILE *fh) {
+static void parse_file(types_list_t *tl, FILE *fh) {
   char buf[4096];
   size_t buf_len;
 
@@ -154,16 +199,204 @@ static void parse_file(FILE *fh) {
     if (buf_len == 0)
       continue;
 
-    parse_line(buf);
+    parse_line(tl, buf);
   } /* while (fgets) */
 } /* void parse_file */
 
+static void types_list_free(types_list_t *tl) {
+  for (size_t i = 0; i < tl->sets_num; i++)
+    sfree(tl->sets[i].ds);
+  sfree(tl->sets);
+  tl->sets_num = 0;
+} /* void types_list_free */
+
+/* Returns the name of the compiled version of "file" in "cache_dir". The
+ * hash of the source file's absolute path keeps files with the same base name
+ * apart. */
+static int types_cache_name(char *buffer, size_t buffer_size, /* {{{ */
+                            char const *cache_dir, char const *file) {
+  char path[PATH_MAX];
+  if (realpath(file, path) == NULL)
+    return errno;
+
+  char const *base = strrchr(path, '/');
+  base = (base == NULL) ? path : base + 1;
+
+  int status = snprintf(buffer, buffer_size, "%s/%s-%016" PRIx64 ".cache",
+                        cache_dir, base, hash_name(path));
+  if ((status < 0) || ((size_t)status >= buffer_size))
+    return ENAMETOOLONG;
+
+  return 0;
+} /* }}} int types_cache_name */
+
+static void types_cache_header_init(types_cache_header_t *hdr, /* {{{ */
+                                    struct stat const *src) {
+  memset(hdr, 0, sizeof(*hdr));
+  memcpy(hdr->magic, TYPES_CACHE_MAGIC, sizeof(TYPES_CACHE_MAGIC));
+  hdr->version = TYPES_CACHE_VERSION;
+  hdr->name_len = DATA_MAX_NAME_LEN;
+  hdr->source_size = sizeof(data_source_t);
+  hdr->set_size = sizeof(types_cache_set_t);
+  hdr->src_dev = (uint64_t)src->st_dev;
+  hdr->src_ino = (uint64_t)src->st_ino;
+  hdr->src_size = (uint64_t)src->st_size;
+  hdr->src_mtime = (int64_t)src->st_mtime;
+} /* }}} void types_cache_header_init */
+
+/* Registers the data sets of a compiled types database. Returns zero on
+ * success, ENOENT if there is no compiled file and EINVAL if it is outdated or
+ * broken. Nothing is registered unless zero is returned. */
+static int types_cache_load(char const *cache_file, /* {{{ */
+                            struct stat const *src) {
+  int fd = open(cache_file, O_RDONLY);
+  if (fd < 0)
+    return errno;
+
+  struct stat st;
+  if ((fstat(fd, &st) != 0) ||
+      ((size_t)st.st_size < sizeof(types_cache_header_t))) {
+    close(fd);
+    return EINVAL;
+  }
+
+  size_t size = (size_t)st.st_size;
+  void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return errno;
+
+  types_cache_header_t want;
+  types_cache_header_init(&want, src);
+
+  types_cache_header_t const *hdr = map;
+  if ((memcmp(hdr->magic, want.magic, sizeof(want.magic)) != 0) ||
+      (hdr->version != want.version) || (hdr->name_len != want.name_len) ||
+      (hdr->source_size != want.source_size) ||
+      (hdr->set_size != want.set_size) || (hdr->src_dev != want.src_dev) ||
+      (hdr->src_ino != want.src_ino) || (hdr->src_size != want.src_size) ||
+      (hdr->src_mtime != want.src_mtime) ||
+      (size != sizeof(*hdr) + (size_t)hdr->sets_num * sizeof(types_cache_set_t) +
+                   (size_t)hdr->sources_num * sizeof(data_source_t))) {
+    munmap(map, size);
+    return EINVAL;
+  }
+
+  types_cache_set_t const *sets = (void *)((char *)map + sizeof(*hdr));
+  data_source_t *sources = (void *)(sets + hdr->sets_num);
+
+  /* Check all records before registering anything, so a broken file can be
+   * replaced by parsing the source. */
+  for (uint32_t i = 0; i < hdr->sets_num; i++) {
+    if ((sets[i].ds_num == 0) || (sets[i].ds_offset > hdr->sources_num) ||
+        (sets[i].ds_num > hdr->sources_num - sets[i].ds_offset) ||
+        (strnlen(sets[i].type, sizeof(sets[i].type)) >=
+         sizeof(sets[i].type))) {
+      munmap(map, size);
+      return EINVAL;
+    }
+  }
+
+  for (uint32_t i = 0; i < hdr->sets_num; i++) {
+    data_set_t ds = {
+        .ds_num = sets[i].ds_num,
+        .ds = sources + sets[i].ds_offset,
+    };
+    sstrncpy(ds.type, sets[i].type, sizeof(ds.type));
+
+    /* Copies the data sources, so the file can be unmapped afterwards. */
+    plugin_register_data_set(&ds);
+  }
+
+  munmap(map, size);
+  return 0;
+} /* }}} int types_cache_load */
+
+/* Writes the compiled version of a types database. The file is replaced
+ * atomically, so concurrently starting daemons never read a partial file. */
+static int types_cache_write(char const *cache_file, /* {{{ */
+                             struct stat const *src,
+                             types_list_t const *tl) {
+  types_cache_header_t hdr;
+  types_cache_header_init(&hdr, src);
+  hdr.sets_num = (uint32_t)tl->sets_num;
+  for (size_t i = 0; i < tl->sets_num; i++)
+    hdr.sources_num += (uint32_t)tl->sets[i].ds_num;
+
+  char tmp_file[PATH_MAX];
+  if ((size_t)snprintf(tmp_file, sizeof(tmp_file), "%s.XXXXXX", cache_file) >=
+      sizeof(tmp_file))
+    return ENAMETOOLONG;
+
+  int fd = mkstemp(tmp_file);
+  if (fd < 0)
+    return errno;
+
+  FILE *fh = fdopen(fd, "w");
+  if (fh == NULL) {
+    int status = errno;
+    close(fd);
+    unlink(tmp_file);
+    return status;
+  }
+
+  errno = 0;
+  bool ok = (fwrite(&hdr, sizeof(hdr), 1, fh) == 1);
+
+  uint32_t offset = 0;
+  for (size_t i = 0; ok && (i < tl->sets_num); i++) {
+    types_cache_set_t set = {
+        .ds_offset = offset,
+        .ds_num = (uint32_t)tl->sets[i].ds_num,
+    };
+    sstrncpy(set.type, tl->sets[i].type, sizeof(set.type));
+    ok = (fwrite(&set, sizeof(set), 1, fh) == 1);
+    offset += set.ds_num;
+  }
+
+  for (size_t i = 0; ok && (i < tl->sets_num); i++)
+    ok = (fwrite(tl->sets[i].ds, sizeof(*tl->sets[i].ds), tl->sets[i].ds_num,
+                 fh) == tl->sets[i].ds_num);
+
+  int status = ok ? 0 : ((errno != 0) ? errno : EIO);
+  if ((fclose(fh) != 0) && (status == 0))
+    status = errno;
+  if ((status == 0) && (rename(tmp_file, cache_file) != 0))
+    status = errno;
+
+  if (status != 0)
+    unlink(tmp_file);
+
+  return status;
+} /* }}} int types_cache_write */
+
 int read_types_list(const char *file) {
   FILE *fh;
 
   if (file == NULL)
     return -1;
 
+  /* With "TypesDBCache", a compiled version of the file is used if it is
+   * current, and (re)written otherwise. */
+  char const *cache_dir = global_option_get("TypesDBCache");
+  char cache_file[PATH_MAX] = "";
+  struct stat src = {0};
+
+  if ((cache_dir != NULL) && (cache_dir[0] != 0) && (stat(file, &src) == 0) &&
+      (types_cache_name(cache_file, sizeof(cache_file), cache_dir, file) ==
+       0)) {
+    int status = types_cache_load(cache_file, &src);
+    if (status == 0) {
+      DEBUG("Loaded compiled types database `%s' for `%s'", cache_file, file);
+      return 0;
+    } else if (status != ENOENT) {
+      DEBUG("Compiled types database `%s' for `%s' is outdated or broken.",
+            cache_file, file);
+    }
+  } else {
+    cache_file[0] = 0;
+  }
+
   fh = fopen(file, "r");
   if (fh == NULL) {
     fprintf(stderr, "Failed to open types database `%s': %s.\n", file,
@@ -172,11 +405,24 @@ int read_types_list(const char *file) {
     return -1;
   }
 
-  parse_file(fh);
+  types_list_t tl = {0};
+  parse_file(&tl, fh);
 
   fclose(fh);
   fh = NULL;
 
+  for (size_t i = 0; i < tl.sets_num; i++)
+    plugin_register_data_set(tl.sets + i);
+
+  if (cache_file[0] != 0) {
+    int status = types_cache_write(cache_file, &src, &tl);
+    if (status != 0)
+      WARNING("Writing the compiled types database `%s' failed: %s",
+              cache_file, STRERROR(status));
+  }
+
+  types_list_free(&tl);
+
   DEBUG("Done parsing `%s'", file);
 
   return 0;
@@ -0,0 +1,116 @@
+/**
+ * collectd - src/daemon/types_list_test.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "types_list.c" /* sic */
+#include "testing.h"
+
+/* Usually defined in configfile.c. */
+const char *global_option_get(__attribute__((unused)) const char *option) {
+  return NULL;
+}
+
+static char dir[] = "/tmp/types_list_test.XXXXXX";
+static char src_file[PATH_MAX];
+static char cache_file[PATH_MAX];
+
+static int write_src(char const *content) {
+  FILE *fh = fopen(src_file, "w");
+  CHECK_NOT_NULL(fh);
+  fputs(content, fh);
+  fclose(fh);
+  return 0;
+}
+
+static int parse_src(types_list_t *tl) {
+  FILE *fh = fopen(src_file, "r");
+  CHECK_NOT_NULL(fh);
+  parse_file(tl, fh);
+  fclose(fh);
+  return 0;
+}
+
+DEF_TEST(parse) {
+  types_list_t tl = {0};
+
+  CHECK_ZERO(write_src("# comment\n"
+                       "gauge value:GAUGE:U:U\n"
+                       "if_octets rx:DERIVE:0:U, tx:DERIVE:0:U\n"
+                       "broken value:BOGUS:0:U\n"));
+  parse_src(&tl);
+
+  EXPECT_EQ_UINT64(2, tl.sets_num);
+  EXPECT_EQ_STR("gauge", tl.sets[0].type);
+  EXPECT_EQ_UINT64(1, tl.sets[0].ds_num);
+  EXPECT_EQ_STR("if_octets", tl.sets[1].type);
+  EXPECT_EQ_UINT64(2, tl.sets[1].ds_num);
+  EXPECT_EQ_STR("tx", tl.sets[1].ds[1].name);
+  EXPECT_EQ_INT(DS_TYPE_DERIVE, tl.sets[1].ds[1].type);
+  EXPECT_EQ_DOUBLE(0.0, tl.sets[1].ds[1].min);
+
+  types_list_free(&tl);
+  return 0;
+}
+
+DEF_TEST(cache) {
+  types_list_t tl = {0};
+  struct stat st;
+
+  CHECK_ZERO(write_src("gauge value:GAUGE:U:U\n"
+                       "if_octets rx:DERIVE:0:U, tx:DERIVE:0:U\n"));
+  parse_src(&tl);
+  CHECK_ZERO(stat(src_file, &st));
+
+  CHECK_ZERO(types_cache_name(cache_file, sizeof(cache_file), dir, src_file));
+  EXPECT_EQ_INT(ENOENT, types_cache_load(cache_file, &st));
+
+  CHECK_ZERO(types_cache_write(cache_file, &st, &tl));
+  EXPECT_EQ_INT(0, types_cache_load(cache_file, &st));
+
+  /* A changed source invalidates the compiled file. */
+  struct stat changed = st;
+  changed.st_size++;
+  EXPECT_EQ_INT(EINVAL, types_cache_load(cache_file, &changed));
+  changed = st;
+  changed.st_mtime++;
+  EXPECT_EQ_INT(EINVAL, types_cache_load(cache_file, &changed));
+
+  /* So does a truncated file. */
+  CHECK_ZERO(truncate(cache_file, sizeof(types_cache_header_t) + 1));
+  EXPECT_EQ_INT(EINVAL, types_cache_load(cache_file, &st));
+
+  types_list_free(&tl);
+  unlink(cache_file);
+  return 0;
+}
+
+int main(void) {
+  CHECK_NOT_NULL(mkdtemp(dir));
+  snprintf(src_file, sizeof(src_file), "%s/types.db", dir);
+
+  RUN_TEST(parse);
+  RUN_TEST(cache);
+
+  unlink(src_file);
+  rmdir(dir);
+  END_TEST;
+}
@@ -28,19 +28,52 @@
 
 #include "collectd.h"
 
+#include "configfile.h"
 #include "plugin.h"
-#include "utils/avltree/avltree.h"
+#include "probes.h"
 #include "utils/common/common.h"
+#include "utils/memstats/memstats.h"
 #include "utils/metadata/meta_data.h"
 #include "utils_cache.h"
+#include "utils_complain.h"
 
 #include <assert.h>
-
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Columnar ring buffer holding the most recent updates of a cache entry: one
+ * column of timestamps and, for each data source, one column of rates and one
+ * column of raw values. Column `ds' of `rates' starts at
+ * `rates + ds * capacity', the same goes for `values'. */
+typedef struct {
+  size_t capacity;
+  size_t num;   /* number of samples stored, at most `capacity'. */
+  size_t index; /* position the next sample is written to. */
+  cdtime_t *times;
+  gauge_t *rates;
+  value_t *values;
+} cache_history_t;
+
+/* An entry is a single allocation: the struct is followed by the three value
+ * arrays and the name, so that it takes little more than the data it holds.
+ * Parts most entries don't have, like the history and the meta data, are
+ * allocated separately when needed. */
 typedef struct cache_entry_s {
-  char name[6 * DATA_MAX_NAME_LEN];
+  /* Points to the end of the entry, see cache_alloc(). */
+  char *name;
+  /* hash_name(name) */
+  uint64_t hash;
   size_t values_num;
+  /* Rates are computed lazily, see uc_compute_rates(). `values_gauge' is only
+   * valid if `rates_stale' is false. */
   gauge_t *values_gauge;
   value_t *values_raw;
+  /* The raw values and time of the previous update. */
+  value_t *values_prev;
+  cdtime_t prev_time;
+  bool rates_stale;
+  /* For looking up the conversion plan when computing rates. */
+  ds_handle_t ds_handle;
   /* Time contained in the package
    * (for calculating rates) */
   cdtime_t last_time;
@@ -52,65 +85,545 @@ typedef struct cache_entry_s {
   cdtime_t interval;
   int state;
   int hits;
+  /* Number of updates in a row that did not change the values. */
+  int unchanged;
+  /* Set for entries read by uc_load_file() until their first update, which is
+   * announced to cache event callbacks as a new value list. */
+  bool restored;
 
-  /*
-   * +-----+-----+-----+-----+-----+-----+-----+-----+-----+----
-   * !  0  !  1  !  2  !  3  !  4  !  5  !  6  !  7  !  8  ! ...
-   * +-----+-----+-----+-----+-----+-----+-----+-----+-----+----
-   * ! ds0 ! ds1 ! ds2 ! ds0 ! ds1 ! ds2 ! ds0 ! ds1 ! ds2 ! ...
-   * +-----+-----+-----+-----+-----+-----+-----+-----+-----+----
-   * !      t = 0      !      t = 1      !      t = 2      ! ...
-   * +-----------------+-----------------+-----------------+----
-   */
-  gauge_t *history;
-  size_t history_index; /* points to the next position to write to. */
-  size_t history_length;
+  /* Allocated for all entries if "CacheHistoryLength" is set, and on demand
+   * by uc_get_history. */
+  cache_history_t *history;
 
   meta_data_t *meta;
   unsigned long callbacks_mask;
+
+  /* Result of the last threshold search, valid if `threshold_generation'
+   * matches the generation passed to uc_get_threshold. Zero means nothing has
+   * been cached yet. */
+  struct threshold_s *threshold;
+  uint64_t threshold_generation;
+
+  /* One reference is held by the shard's hash table, one by each directory
+   * (see below) containing the entry. */
+  unsigned int refs;
+
+  /* Links of the timer wheel slot holding the entry, see wheel_add().
+   * `wheel_pprev' is NULL if the entry is in no slot. */
+  struct cache_entry_s *wheel_next;
+  struct cache_entry_s **wheel_pprev;
+
+  /* The plugin which dispatched the first value list, see memstats.h. */
+  memstats_owner_t *owner;
 } cache_entry_t;
 
+/* The fields that snapshot readers access without holding the shard lock are
+ * written with these, also under the lock. */
+#define CE_LOAD(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+#define CE_STORE(field, value)                                                 \
+  __atomic_store_n(&(field), (value), __ATOMIC_RELAXED)
+
+/* A directory is a read-only, reference counted list of a shard's entries. It
+ * is rebuilt when entries have been added or removed, so repeated snapshots of
+ * an unchanged shard cost a reference count increment. */
+typedef struct {
+  unsigned int refs;
+  size_t entries_num;
+  cache_entry_t *entries[];
+} cache_dir_t;
+
+/* The cache is split into UC_SHARDS_NUM independently locked partitions. The
+ * shard a value list belongs to is determined by a hash of its identifier.
+ * Within a shard, entries are kept in an open addressing hash table (linear
+ * probing) using the same hash, so that lookups don't need to format the
+ * identifier and compare strings along a tree. */
+#ifndef UC_SHARDS_NUM
+#define UC_SHARDS_NUM 64
+#endif
+
+#define UC_SLOTS_MIN 16
+
+/* Expiry deadlines are kept in a hierarchical timer wheel per shard, so that
+ * uc_check_timeout() only visits entries that are about to expire. Level zero
+ * has a slot per tick, each slot of the next level covers all slots of the
+ * level below and is spread over them when it comes up. */
+#define WHEEL_TICK TIME_T_TO_CDTIME_T_STATIC(1)
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 3
+/* Number of ticks the wheel covers. Later deadlines are kept in the farthest
+ * slot until they come into range. */
+#define WHEEL_RANGE ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS))
+
+typedef struct {
+  /* Each slot points to a cache entry or is NULL. The slots array size is a
+   * power of two and at most half of the slots are used. */
+  cache_entry_t **slots;
+  size_t slots_num;
+  size_t entries_num;
+  pthread_mutex_t lock;
+
+  cache_dir_t *dir;
+  bool dir_stale;
+
+  /* Lists of entries linked by `wheel_next'. Ticks up to and including
+   * `wheel_tick' have been processed. */
+  cache_entry_t *wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+  uint64_t wheel_tick;
+} cache_shard_t;
+
+/* A cache_key_t identifies a cache entry either by its name or by the
+ * identifier of a value list. `hash' is the same in both cases. */
+typedef struct {
+  uint64_t hash;
+  const char *name;
+  const value_list_t *vl;
+} cache_key_t;
+
 struct uc_iter_s {
-  c_avl_iterator_t *iter;
+  /* Only the lock of `cache_shards[shard]' is held by an iterator. */
+  size_t shard;
+  size_t slot;
+  bool locked;
 
   char *name;
   cache_entry_t *entry;
 };
 
-static c_avl_tree_t *cache_tree;
-static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+struct uc_snapshot_s {
+  cache_dir_t *dirs[UC_SHARDS_NUM];
+  /* offsets[i] is the snapshot index of dirs[i]->entries[0]. */
+  size_t offsets[UC_SHARDS_NUM + 1];
+};
 
-static int cache_compare(const cache_entry_t *a, const cache_entry_t *b) {
-#if COLLECT_DEBUG
-  assert((a != NULL) && (b != NULL));
-#endif
-  return strcmp(a->name, b->name);
-} /* int cache_compare */
+static cache_shard_t cache_shards[UC_SHARDS_NUM];
+static bool cache_initialized;
+/* Set by uc_get_rate_attached(), see uc_rates_wanted(). */
+static bool rates_wanted;
+
+/* "CacheHistoryLength" and "CacheHistoryMemoryLimit" (converted to bytes). */
+static size_t history_length;
+static size_t history_memory_limit;
+static size_t history_memory_used;
+static c_complain_t history_complaint = C_COMPLAIN_INIT_STATIC;
+
+static cache_key_t cache_key_name(const char *name) {
+  return (cache_key_t){
+      .hash = hash_name(name),
+      .name = name,
+  };
+} /* cache_key_t cache_key_name */
+
+static cache_key_t cache_key_vl(const value_list_t *vl) {
+  return (cache_key_t){
+      .hash = HASH_VL(vl),
+      .vl = vl,
+  };
+} /* cache_key_t cache_key_vl */
+
+/* The low bits of the hash are used for the slot index within a shard, so use
+ * the high bits to pick the shard. */
+static cache_shard_t *cache_get_shard(cache_key_t const *key) {
+  return &cache_shards[(key->hash >> 32) % UC_SHARDS_NUM];
+} /* cache_shard_t *cache_get_shard */
+
+/* Advances `*pos' past `part' if `*pos' starts with it. */
+static bool name_consume(const char **pos, const char *part) {
+  size_t len = strlen(part);
+  if (strncmp(*pos, part, len) != 0)
+    return false;
+  *pos += len;
+  return true;
+} /* bool name_consume */
+
+/* Compares the name of a cache entry with the identifier of a value list
+ * without formatting the identifier, see format_name(). */
+static bool name_matches_vl(const char *name, const value_list_t *vl) {
+  const char *pos = name;
+
+  if (!name_consume(&pos, vl->host) || !name_consume(&pos, "/") ||
+      !name_consume(&pos, vl->plugin))
+    return false;
+  if ((vl->plugin_instance[0] != 0) &&
+      (!name_consume(&pos, "-") || !name_consume(&pos, vl->plugin_instance)))
+    return false;
+  if (!name_consume(&pos, "/") || !name_consume(&pos, vl->type))
+    return false;
+  if ((vl->type_instance[0] != 0) &&
+      (!name_consume(&pos, "-") || !name_consume(&pos, vl->type_instance)))
+    return false;
+
+  return pos[0] == 0;
+} /* bool name_matches_vl */
+
+static bool cache_key_matches(cache_key_t const *key, cache_entry_t *ce) {
+  if (ce->hash != key->hash)
+    return false;
+  if (key->name != NULL)
+    return strcmp(ce->name, key->name) == 0;
+  return name_matches_vl(ce->name, key->vl);
+} /* bool cache_key_matches */
+
+/* Returns the index of the slot holding the entry identified by `key' or, if
+ * there is no such entry, of the empty slot where it would be inserted. Must
+ * not be called with an empty slots array. */
+static size_t cache_find_slot(cache_shard_t *shard, cache_key_t const *key) {
+  size_t mask = shard->slots_num - 1;
+  size_t i = (size_t)key->hash & mask;
+
+  while ((shard->slots[i] != NULL) && !cache_key_matches(key, shard->slots[i]))
+    i = (i + 1) & mask;
+
+  return i;
+} /* size_t cache_find_slot */
+
+/* Must hold shard->lock when calling. */
+static cache_entry_t *cache_lookup(cache_shard_t *shard,
+                                   cache_key_t const *key) {
+  if (shard->entries_num == 0)
+    return NULL;
 
-static cache_entry_t *cache_alloc(size_t values_num) {
-  cache_entry_t *ce;
+  return shard->slots[cache_find_slot(shard, key)];
+} /* cache_entry_t *cache_lookup */
 
-  ce = calloc(1, sizeof(*ce));
-  if (ce == NULL) {
-    ERROR("utils_cache: cache_alloc: calloc failed.");
+/* Must hold shard->lock when calling. */
+static int cache_resize(cache_shard_t *shard, size_t slots_num) {
+  cache_entry_t **slots = calloc(slots_num, sizeof(*slots));
+  if (slots == NULL) {
+    ERROR("utils_cache: cache_resize: calloc failed.");
+    return ENOMEM;
+  }
+
+  for (size_t i = 0; i < shard->slots_num; i++) {
+    cache_entry_t *ce = shard->slots[i];
+    if (ce == NULL)
+      continue;
+
+    size_t j = (size_t)ce->hash & (slots_num - 1);
+    while (slots[j] != NULL)
+      j = (j + 1) & (slots_num - 1);
+    slots[j] = ce;
+  }
+
+  sfree(shard->slots);
+  shard->slots = slots;
+  shard->slots_num = slots_num;
+  return 0;
+} /* int cache_resize */
+
+/* Must hold shard->lock when calling. The entry must not exist yet. */
+static int cache_insert(cache_shard_t *shard, cache_entry_t *ce) {
+  if (2 * (shard->entries_num + 1) > shard->slots_num) {
+    size_t slots_num =
+        (shard->slots_num == 0) ? UC_SLOTS_MIN : 2 * shard->slots_num;
+    int status = cache_resize(shard, slots_num);
+    if (status != 0)
+      return status;
+  }
+
+  cache_key_t key = cache_key_name(ce->name);
+  size_t i = cache_find_slot(shard, &key);
+  assert(shard->slots[i] == NULL);
+
+  ce->refs = 1;
+  shard->slots[i] = ce;
+  shard->entries_num++;
+  shard->dir_stale = true;
+  return 0;
+} /* int cache_insert */
+
+/* Returns the tick in which `ce' is due to expire. */
+static uint64_t wheel_expires(cache_entry_t const *ce) {
+  return (ce->last_update + ce->interval * timeout_g) / WHEEL_TICK;
+} /* uint64_t wheel_expires */
+
+/* Must hold shard->lock when calling. */
+static void wheel_unlink(cache_entry_t *ce) {
+  if (ce->wheel_pprev == NULL)
+    return;
+
+  *ce->wheel_pprev = ce->wheel_next;
+  if (ce->wheel_next != NULL)
+    ce->wheel_next->wheel_pprev = ce->wheel_pprev;
+  ce->wheel_next = NULL;
+  ce->wheel_pprev = NULL;
+} /* void wheel_unlink */
+
+/* (Re-)files `ce' by its current deadline. An entry due within
+ * WHEEL_SLOTS^(l+1) ticks is put into level `l', in the slot of its deadline's
+ * digit at that level. It is moved down when the slot is reached, i.e. before
+ * its deadline. Must hold shard->lock when calling. */
+static void wheel_add(cache_shard_t *shard, cache_entry_t *ce) {
+  wheel_unlink(ce);
+
+  /* Ticks are compared by their difference, so that the wheel keeps working
+   * if they wrap around. */
+  uint64_t expires = wheel_expires(ce);
+  if ((int64_t)(expires - shard->wheel_tick) <= 0)
+    expires = shard->wheel_tick + 1;
+  if (expires - shard->wheel_tick >= WHEEL_RANGE)
+    expires = shard->wheel_tick + WHEEL_RANGE - 1;
+
+  uint64_t delta = expires - shard->wheel_tick;
+  size_t level = 0;
+  while ((level < WHEEL_LEVELS - 1) &&
+         (delta >= ((uint64_t)1 << (WHEEL_BITS * (level + 1)))))
+    level++;
+
+  cache_entry_t **head =
+      &shard->wheel[level][(expires >> (WHEEL_BITS * level)) &
+                           (WHEEL_SLOTS - 1)];
+  ce->wheel_next = *head;
+  ce->wheel_pprev = head;
+  if (*head != NULL)
+    (*head)->wheel_pprev = &ce->wheel_next;
+  *head = ce;
+} /* void wheel_add */
+
+/* Empties the slot `head' and returns the first of its entries, which are
+ * still linked by `wheel_next' but no longer in any slot. */
+static cache_entry_t *wheel_take(cache_entry_t **head) {
+  cache_entry_t *list = *head;
+  *head = NULL;
+  for (cache_entry_t *ce = list; ce != NULL; ce = ce->wheel_next)
+    ce->wheel_pprev = NULL;
+  return list;
+} /* cache_entry_t *wheel_take */
+
+/* Re-files all entries of the slot `head'. */
+static void wheel_cascade(cache_shard_t *shard, cache_entry_t **head) {
+  cache_entry_t *ce = wheel_take(head);
+  while (ce != NULL) {
+    cache_entry_t *next = ce->wheel_next;
+    wheel_add(shard, ce);
+    ce = next;
+  }
+} /* void wheel_cascade */
+
+/* Removes the entries of `shard' whose deadline has passed at `now' from the
+ * wheel and calls `callback' for each of them. An entry is put back into the
+ * wheel when it is updated, or right away if `callback' fails. Must hold
+ * shard->lock when calling. */
+static void wheel_advance(cache_shard_t *shard, cdtime_t now,
+                          int (*callback)(cache_entry_t *, void *),
+                          void *user_data) {
+  uint64_t now_tick = now / WHEEL_TICK;
+
+  /* If the clock jumped, start over rather than stepping through all the
+   * ticks in between. This includes going backwards. */
+  if (now_tick - shard->wheel_tick > WHEEL_RANGE) {
+    shard->wheel_tick = now_tick - 1;
+    for (size_t l = 0; l < WHEEL_LEVELS; l++)
+      for (size_t i = 0; i < WHEEL_SLOTS; i++)
+        wheel_cascade(shard, &shard->wheel[l][i]);
+  }
+
+  for (uint64_t tick = shard->wheel_tick + 1; tick <= now_tick; tick++) {
+    /* Entries re-filed while processing this tick go into its slots. */
+    shard->wheel_tick = tick - 1;
+
+    for (size_t l = WHEEL_LEVELS - 1; l > 0; l--) {
+      uint64_t mask = ((uint64_t)1 << (WHEEL_BITS * l)) - 1;
+      if ((tick & mask) == 0)
+        wheel_cascade(shard,
+                      &shard->wheel[l][(tick >> (WHEEL_BITS * l)) &
+                                       (WHEEL_SLOTS - 1)]);
+    }
+
+    cache_entry_t *ce = wheel_take(&shard->wheel[0][tick & (WHEEL_SLOTS - 1)]);
+    while (ce != NULL) {
+      cache_entry_t *next = ce->wheel_next;
+      ce->wheel_next = NULL;
+
+      cdtime_t deadline = ce->last_update + ce->interval * timeout_g;
+      if ((ce->last_update > now) || (deadline > now) ||
+          ((*callback)(ce, user_data) != 0))
+        wheel_add(shard, ce);
+      ce = next;
+    }
+
+    /* The current tick is processed again by the next call, since entries
+     * may expire later within it. */
+    if (tick < now_tick)
+      shard->wheel_tick = tick;
+  }
+} /* void wheel_advance */
+
+/* Removes the entry identified by `key' and returns it, or NULL if there is no
+ * such entry. The caller owns the hash table's reference to the entry
+ * afterwards, see cache_entry_unref(). Must hold shard->lock when calling. */
+static cache_entry_t *cache_remove(cache_shard_t *shard,
+                                   cache_key_t const *key) {
+  if (shard->entries_num == 0)
+    return NULL;
+
+  size_t mask = shard->slots_num - 1;
+  size_t i = cache_find_slot(shard, key);
+  cache_entry_t *ce = shard->slots[i];
+  if (ce == NULL)
     return NULL;
+  wheel_unlink(ce);
+
+  /* Backward shift deletion: move following entries of the same probe
+   * sequence into the gap, so that lookups don't stop early. */
+  size_t j = i;
+  while (42) {
+    shard->slots[i] = NULL;
+    do {
+      j = (j + 1) & mask;
+      if (shard->slots[j] == NULL) {
+        shard->entries_num--;
+        shard->dir_stale = true;
+        return ce;
+      }
+      /* `home' is the slot the entry at `j' would ideally be in. It may stay
+       * where it is if `home' is cyclically in (i, j]. */
+      size_t home = (size_t)shard->slots[j]->hash & mask;
+      if ((i <= j) ? ((i < home) && (home <= j)) : ((i < home) || (home <= j)))
+        continue;
+      break;
+    } while (42);
+    shard->slots[i] = shard->slots[j];
+    i = j;
   }
-  ce->values_num = values_num;
+} /* cache_entry_t *cache_remove */
+
+static size_t cache_history_size(size_t values_num, size_t capacity) {
+  return sizeof(cache_history_t) +
+         capacity * (sizeof(cdtime_t) +
+                     values_num * (sizeof(gauge_t) + sizeof(value_t)));
+} /* size_t cache_history_size */
 
-  ce->values_gauge = calloc(values_num, sizeof(*ce->values_gauge));
-  ce->values_raw = calloc(values_num, sizeof(*ce->values_raw));
-  if ((ce->values_gauge == NULL) || (ce->values_raw == NULL)) {
-    sfree(ce->values_gauge);
-    sfree(ce->values_raw);
-    sfree(ce);
+static void cache_history_free(cache_entry_t *ce) {
+  if (ce->history == NULL)
+    return;
+
+  __atomic_sub_fetch(&history_memory_used,
+                     cache_history_size(ce->values_num, ce->history->capacity),
+                     __ATOMIC_RELAXED);
+  sfree(ce->history->times);
+  sfree(ce->history->rates);
+  sfree(ce->history->values);
+  sfree(ce->history);
+} /* void cache_history_free */
+
+/* Position of the sample `age' updates before the most recent one. */
+static size_t cache_history_pos(cache_history_t const *h, size_t age) {
+  return (h->index + h->capacity - 1 - age) % h->capacity;
+} /* size_t cache_history_pos */
+
+/* (Re)allocates the entry's history with room for `capacity' samples, keeping
+ * the most recent samples. If `enforce_limit' is true, fails with ENOSPC
+ * instead of exceeding the history memory limit. Must hold the shard's lock
+ * when calling. */
+static int cache_history_resize(cache_entry_t *ce, size_t capacity,
+                                bool enforce_limit) {
+  size_t values_num = ce->values_num;
+  size_t size = cache_history_size(values_num, capacity);
+
+  size_t used = __atomic_add_fetch(&history_memory_used, size,
+                                   __ATOMIC_RELAXED);
+  if (enforce_limit && (history_memory_limit > 0) &&
+      (used > history_memory_limit)) {
+    __atomic_sub_fetch(&history_memory_used, size, __ATOMIC_RELAXED);
+    c_complain_once(LOG_WARNING, &history_complaint,
+                    "utils_cache: CacheHistoryMemoryLimit reached, not "
+                    "keeping a history for new metrics.");
+    return ENOSPC;
+  }
+
+  cache_history_t *h = calloc(1, sizeof(*h));
+  if (h != NULL) {
+    h->capacity = capacity;
+    h->times = calloc(capacity, sizeof(*h->times));
+    h->rates = calloc(capacity * values_num, sizeof(*h->rates));
+    h->values = calloc(capacity * values_num, sizeof(*h->values));
+  }
+  if ((h == NULL) || (h->times == NULL) || (h->rates == NULL) ||
+      (h->values == NULL)) {
+    ERROR("utils_cache: cache_history_resize: calloc failed.");
+    if (h != NULL) {
+      sfree(h->times);
+      sfree(h->rates);
+      sfree(h->values);
+      sfree(h);
+    }
+    __atomic_sub_fetch(&history_memory_used, size, __ATOMIC_RELAXED);
+    return ENOMEM;
+  }
+
+  /* Copy the old samples, oldest first. */
+  cache_history_t *old = ce->history;
+  if (old != NULL) {
+    size_t num = (old->num < capacity) ? old->num : capacity;
+    for (size_t age = num; age > 0; age--) {
+      size_t src = cache_history_pos(old, age - 1);
+      h->times[h->index] = old->times[src];
+      for (size_t ds = 0; ds < values_num; ds++) {
+        h->rates[ds * capacity + h->index] = old->rates[ds * old->capacity + src];
+        h->values[ds * capacity + h->index] =
+            old->values[ds * old->capacity + src];
+      }
+      h->index = (h->index + 1) % capacity;
+    }
+    h->num = num;
+    cache_history_free(ce);
+  }
+
+  ce->history = h;
+  return 0;
+} /* int cache_history_resize */
+
+/* Appends the entry's current values to its history. Must hold the shard's
+ * lock when calling. */
+static void cache_history_append(cache_entry_t *ce) {
+  cache_history_t *h = ce->history;
+  if (h == NULL)
+    return;
+
+  h->times[h->index] = ce->last_time;
+  for (size_t ds = 0; ds < ce->values_num; ds++) {
+    h->rates[ds * h->capacity + h->index] = ce->values_gauge[ds];
+    h->values[ds * h->capacity + h->index] = ce->values_raw[ds];
+  }
+
+  h->index = (h->index + 1) % h->capacity;
+  if (h->num < h->capacity)
+    h->num++;
+} /* void cache_history_append */
+
+/* The entry, its three value arrays and its name, including the terminating
+ * null byte. All members of value_t and gauge_t have the same alignment as the
+ * struct. */
+#define CACHE_ENTRY_SIZE(values_num, name_len)                                 \
+  (sizeof(cache_entry_t) +                                                     \
+   (values_num) * (sizeof(gauge_t) + 2 * sizeof(value_t)) + (name_len) + 1)
+
+static cache_entry_t *cache_alloc(size_t values_num, char const *name) {
+  size_t name_len = strlen(name);
+  if (name_len >= 6 * DATA_MAX_NAME_LEN) {
+    ERROR("utils_cache: cache_alloc: name too long: %s", name);
+    return NULL;
+  }
+
+  size_t size = CACHE_ENTRY_SIZE(values_num, name_len);
+  cache_entry_t *ce = calloc(1, size);
+  if (ce == NULL) {
     ERROR("utils_cache: cache_alloc: calloc failed.");
     return NULL;
   }
+  ce->values_num = values_num;
+  ce->values_gauge = (gauge_t *)(ce + 1);
+  ce->values_raw = (value_t *)(ce->values_gauge + values_num);
+  ce->values_prev = ce->values_raw + values_num;
+  ce->name = (char *)(ce->values_prev + values_num);
+  memcpy(ce->name, name, name_len + 1);
 
   ce->history = NULL;
-  ce->history_length = 0;
   ce->meta = NULL;
 
+  ce->owner = memstats_owner_current();
+  memstats_add(ce->owner, (int64_t)size, 1);
   return ce;
 } /* cache_entry_t *cache_alloc */
 
@@ -118,9 +631,9 @@ static void cache_free(cache_entry_t *ce) {
   if (ce == NULL)
     return;
 
-  sfree(ce->values_gauge);
-  sfree(ce->values_raw);
-  sfree(ce->history);
+  size_t size = CACHE_ENTRY_SIZE(ce->values_num, strlen(ce->name));
+  memstats_add(ce->owner, -(int64_t)size, -1);
+  cache_history_free(ce);
   if (ce->meta != NULL) {
     meta_data_destroy(ce->meta);
     ce->meta = NULL;
@@ -128,35 +641,88 @@ static void cache_free(cache_entry_t *ce) {
   sfree(ce);
 } /* void cache_free */
 
-static void uc_check_range(const data_set_t *ds, cache_entry_t *ce) {
-  for (size_t i = 0; i < ds->ds_num; i++) {
-    if (isnan(ce->values_gauge[i]))
-      continue;
-    else if (ce->values_gauge[i] < ds->ds[i].min)
-      ce->values_gauge[i] = NAN;
-    else if (ce->values_gauge[i] > ds->ds[i].max)
-      ce->values_gauge[i] = NAN;
+static void cache_entry_unref(cache_entry_t *ce) {
+  if (__atomic_sub_fetch(&ce->refs, 1, __ATOMIC_ACQ_REL) == 0)
+    cache_free(ce);
+} /* void cache_entry_unref */
+
+static void cache_dir_unref(cache_dir_t *dir) {
+  if (dir == NULL)
+    return;
+  if (__atomic_sub_fetch(&dir->refs, 1, __ATOMIC_ACQ_REL) != 0)
+    return;
+
+  for (size_t i = 0; i < dir->entries_num; i++)
+    cache_entry_unref(dir->entries[i]);
+  free(dir);
+} /* void cache_dir_unref */
+
+/* Returns a new reference to the shard's directory, rebuilding it if
+ * necessary. Must hold shard->lock when calling. */
+static cache_dir_t *cache_dir_get(cache_shard_t *shard) {
+  if ((shard->dir == NULL) || shard->dir_stale) {
+    cache_dir_t *dir = malloc(sizeof(*dir) +
+                              shard->entries_num * sizeof(dir->entries[0]));
+    if (dir == NULL) {
+      ERROR("utils_cache: cache_dir_get: malloc failed.");
+      return NULL;
+    }
+    dir->refs = 1;
+    dir->entries_num = 0;
+
+    for (size_t i = 0; i < shard->slots_num; i++) {
+      cache_entry_t *ce = shard->slots[i];
+      if (ce == NULL)
+        continue;
+
+      __atomic_add_fetch(&ce->refs, 1, __ATOMIC_RELAXED);
+      dir->entries[dir->entries_num] = ce;
+      dir->entries_num++;
+    }
+    assert(dir->entries_num == shard->entries_num);
+
+    cache_dir_unref(shard->dir);
+    shard->dir = dir;
+    shard->dir_stale = false;
   }
-} /* void uc_check_range */
 
-static int uc_insert(const data_set_t *ds, const value_list_t *vl,
-                     const char *key) {
-  /* `cache_lock' has been locked by `uc_update' */
+  __atomic_add_fetch(&shard->dir->refs, 1, __ATOMIC_RELAXED);
+  return shard->dir;
+} /* cache_dir_t *cache_dir_get */
+
+/* Computes the rates of the last update from the raw values of the last two
+ * updates. uc_update() only stores the raw values, so series whose rates are
+ * never read don't pay for the conversion. The conversion plan of the entry's
+ * data set is looked up by its handle. Must hold the shard's lock when
+ * calling. */
+static void uc_compute_rates(cache_entry_t *ce) {
+  if (!ce->rates_stale)
+    return;
+  ce->rates_stale = false;
 
-  char *key_copy = strdup(key);
-  if (key_copy == NULL) {
-    ERROR("uc_insert: strdup failed.");
-    return -1;
+  ds_plan_t const *plan = plugin_get_ds_plan_by_handle(ce->ds_handle);
+  if ((plan == NULL) || (plan->ds_num != ce->values_num)) {
+    for (size_t i = 0; i < ce->values_num; i++)
+      ce->values_gauge[i] = NAN;
+    return;
   }
 
-  cache_entry_t *ce = cache_alloc(ds->ds_num);
+  ds_plan_rates(plan, ce->values_gauge, ce->values_raw, ce->values_prev,
+                ce->last_time - ce->prev_time);
+} /* void uc_compute_rates */
+
+static int uc_insert(cache_shard_t *shard, const data_set_t *ds,
+                     const value_list_t *vl, const char *key) {
+  /* `shard->lock' has been locked by `uc_update' */
+
+  cache_entry_t *ce = cache_alloc(ds->ds_num, key);
   if (ce == NULL) {
-    sfree(key_copy);
     ERROR("uc_insert: cache_alloc (%" PRIsz ") failed.", ds->ds_num);
     return -1;
   }
 
-  sstrncpy(ce->name, key, sizeof(ce->name));
+  ce->hash = hash_name(ce->name);
+  ce->ds_handle = plugin_get_ds_handle(ds->type);
 
   for (size_t i = 0; i < ds->ds_num; i++) {
     switch (ds->ds[i].type) {
@@ -187,17 +753,18 @@ static int uc_insert(const data_set_t *ds, const value_list_t *vl,
       /* This shouldn't happen. */
       ERROR("uc_insert: Don't know how to handle data source type %i.",
             ds->ds[i].type);
-      sfree(key_copy);
       cache_free(ce);
       return -1;
     } /* switch (ds->ds[i].type) */
   }   /* for (i) */
 
   /* Prune invalid gauge data */
-  uc_check_range(ds, ce);
+  ds_plan_t const *plan = plugin_get_ds_plan_by_handle(ce->ds_handle);
+  if ((plan != NULL) && (plan->ds_num == ce->values_num))
+    ds_plan_check_range(plan, ce->values_gauge);
 
   ce->last_time = vl->time;
-  ce->last_update = cdtime();
+  ce->last_update = cdtime_coarse();
   ce->interval = vl->interval;
   ce->state = STATE_UNKNOWN;
 
@@ -205,67 +772,95 @@ static int uc_insert(const data_set_t *ds, const value_list_t *vl,
     ce->meta = meta_data_clone(vl->meta);
   }
 
-  if (c_avl_insert(cache_tree, key_copy, ce) != 0) {
-    sfree(key_copy);
-    ERROR("uc_insert: c_avl_insert failed.");
+  if ((history_length > 0) &&
+      (cache_history_resize(ce, history_length, /* enforce_limit = */ true) ==
+       0))
+    cache_history_append(ce);
+
+  if (cache_insert(shard, ce) != 0) {
+    ERROR("uc_insert: cache_insert failed.");
+    cache_free(ce);
     return -1;
   }
+  wheel_add(shard, ce);
 
   DEBUG("uc_insert: Added %s to the cache.", key);
   return 0;
 } /* int uc_insert */
 
 int uc_init(void) {
-  if (cache_tree == NULL)
-    cache_tree =
-        c_avl_create((int (*)(const void *, const void *))cache_compare);
+  if (cache_initialized)
+    return 0;
+
+  const char *str = global_option_get("CacheHistoryLength");
+  if (str != NULL)
+    history_length = (size_t)strtoull(str, NULL, 10);
+  str = global_option_get("CacheHistoryMemoryLimit");
+  if (str != NULL)
+    history_memory_limit = ((size_t)strtoull(str, NULL, 10)) * 1024 * 1024;
+
+  uint64_t tick = cdtime() / WHEEL_TICK;
+  for (size_t i = 0; i < UC_SHARDS_NUM; i++) {
+    pthread_mutex_init(&cache_shards[i].lock, /* attr = */ NULL);
+    cache_shards[i].wheel_tick = tick - 1;
+  }
+  cache_initialized = true;
 
   return 0;
 } /* int uc_init */
 
-int uc_check_timeout(void) {
-  struct {
-    char *key;
-    cdtime_t time;
-    cdtime_t interval;
-    unsigned long callbacks_mask;
-  } *expired = NULL;
-  size_t expired_num = 0;
-
-  pthread_mutex_lock(&cache_lock);
-  cdtime_t now = cdtime();
+typedef struct {
+  char *key;
+  cdtime_t time;
+  cdtime_t interval;
+  unsigned long callbacks_mask;
+} uc_expired_t;
 
-  /* Build a list of entries to be flushed */
-  c_avl_iterator_t *iter = c_avl_get_iterator(cache_tree);
-  char *key = NULL;
-  cache_entry_t *ce = NULL;
-  while (c_avl_iterator_next(iter, (void *)&key, (void *)&ce) == 0) {
-    /* If the entry is fresh enough, continue. */
-    if ((now - ce->last_update) < (ce->interval * timeout_g))
-      continue;
+typedef struct {
+  uc_expired_t *expired;
+  size_t expired_num;
+} uc_expired_list_t;
 
-    void *tmp = realloc(expired, (expired_num + 1) * sizeof(*expired));
-    if (tmp == NULL) {
-      ERROR("uc_check_timeout: realloc failed.");
-      continue;
-    }
-    expired = tmp;
+/* Callback of wheel_advance(), must hold the shard's lock. */
+static int uc_expired_append(cache_entry_t *ce, void *user_data) {
+  uc_expired_list_t *list = user_data;
+
+  uc_expired_t *tmp =
+      realloc(list->expired, (list->expired_num + 1) * sizeof(*list->expired));
+  if (tmp == NULL) {
+    ERROR("uc_check_timeout: realloc failed.");
+    return ENOMEM;
+  }
+  list->expired = tmp;
+
+  uc_expired_t *e = list->expired + list->expired_num;
+  e->key = strdup(ce->name);
+  e->time = ce->last_time;
+  e->interval = ce->interval;
+  e->callbacks_mask = ce->callbacks_mask;
+  if (e->key == NULL) {
+    ERROR("uc_check_timeout: strdup failed.");
+    return ENOMEM;
+  }
 
-    expired[expired_num].key = strdup(key);
-    expired[expired_num].time = ce->last_time;
-    expired[expired_num].interval = ce->interval;
-    expired[expired_num].callbacks_mask = ce->callbacks_mask;
+  list->expired_num++;
+  return 0;
+} /* int uc_expired_append */
 
-    if (expired[expired_num].key == NULL) {
-      ERROR("uc_check_timeout: strdup failed.");
-      continue;
-    }
+int uc_check_timeout(void) {
+  uc_expired_list_t list = {0};
 
-    expired_num++;
-  } /* while (c_avl_iterator_next) */
+  /* Take the expired entries out of the timer wheels. */
+  cdtime_t now = cdtime();
+  for (size_t i = 0; i < UC_SHARDS_NUM; i++) {
+    cache_shard_t *shard = cache_shards + i;
+    pthread_mutex_lock(&shard->lock);
+    wheel_advance(shard, now, uc_expired_append, &list);
+    pthread_mutex_unlock(&shard->lock);
+  }
 
-  c_avl_iterator_destroy(iter);
-  pthread_mutex_unlock(&cache_lock);
+  uc_expired_t *expired = list.expired;
+  size_t expired_num = list.expired_num;
 
   if (expired_num == 0) {
     sfree(expired);
@@ -296,47 +891,64 @@ int uc_check_timeout(void) {
                                   expired[i].key, &vl);
   } /* for (i = 0; i < expired_num; i++) */
 
-  /* Now actually remove all the values from the cache. We don't re-evaluate
-   * the timestamp again, so in theory it is possible we remove a value after
-   * it is updated here. */
-  pthread_mutex_lock(&cache_lock);
+  /* Now actually remove all the values from the cache. Values updated in the
+   * meantime are back in the timer wheel and are kept. */
   for (size_t i = 0; i < expired_num; i++) {
-    char *key = NULL;
-    cache_entry_t *value = NULL;
+    cache_key_t key = cache_key_name(expired[i].key);
+    cache_shard_t *shard = cache_get_shard(&key);
 
-    if (c_avl_remove(cache_tree, expired[i].key, (void *)&key,
-                     (void *)&value) != 0) {
-      ERROR("uc_check_timeout: c_avl_remove (\"%s\") failed.", expired[i].key);
+    pthread_mutex_lock(&shard->lock);
+    cache_entry_t *value = cache_lookup(shard, &key);
+    if ((value != NULL) && (value->wheel_pprev != NULL)) {
+      pthread_mutex_unlock(&shard->lock);
       sfree(expired[i].key);
       continue;
     }
-    sfree(key);
-    cache_free(value);
+    value = cache_remove(shard, &key);
+    pthread_mutex_unlock(&shard->lock);
+
+    if (value == NULL) {
+      ERROR("uc_check_timeout: cache_remove (\"%s\") failed.", expired[i].key);
+      sfree(expired[i].key);
+      continue;
+    }
+
+    cache_entry_unref(value);
 
     sfree(expired[i].key);
   } /* for (i = 0; i < expired_num; i++) */
-  pthread_mutex_unlock(&cache_lock);
 
   sfree(expired);
   return 0;
 } /* int uc_check_timeout */
 
-int uc_update(const data_set_t *ds, const value_list_t *vl) {
+int uc_update_changed(const data_set_t *ds, const value_list_t *vl,
+                      int max_unchanged, gauge_t *ret_rates) {
   char name[6 * DATA_MAX_NAME_LEN];
+  cache_key_t key = cache_key_vl(vl);
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("uc_update: FORMAT_VL failed.");
-    return -1;
-  }
+  CD_PROBE3(cache_update, vl->plugin, vl->type, vl->time);
 
-  pthread_mutex_lock(&cache_lock);
+  cache_shard_t *shard = cache_get_shard(&key);
+  pthread_mutex_lock(&shard->lock);
 
-  cache_entry_t *ce = NULL;
-  int status = c_avl_get(cache_tree, name, (void *)&ce);
-  if (status != 0) /* entry does not yet exist */
+  cache_entry_t *ce = cache_lookup(shard, &key);
+  if (ce == NULL) /* entry does not yet exist */
   {
-    status = uc_insert(ds, vl, name);
-    pthread_mutex_unlock(&cache_lock);
+    /* The identifier only needs to be formatted for new entries. */
+    int status = FORMAT_VL(name, sizeof(name), vl);
+    if (status != 0) {
+      pthread_mutex_unlock(&shard->lock);
+      ERROR("uc_update: FORMAT_VL failed.");
+      return -1;
+    }
+
+    status = uc_insert(shard, ds, vl, name);
+    if ((status == 0) && (ret_rates != NULL)) {
+      ce = cache_lookup(shard, &key);
+      memcpy(ret_rates, ce->values_gauge, ds->ds_num * sizeof(*ret_rates));
+    }
+    pthread_mutex_unlock(&shard->lock);
 
     if (status == 0)
       plugin_dispatch_cache_event(CE_VALUE_NEW, 0 /* mask */, name, vl);
@@ -348,116 +960,108 @@ int uc_update(const data_set_t *ds, const value_list_t *vl) {
   assert(ce->values_num == ds->ds_num);
 
   if (ce->last_time >= vl->time) {
-    pthread_mutex_unlock(&cache_lock);
+    cdtime_t last_time = ce->last_time;
+    sstrncpy(name, ce->name, sizeof(name));
+    pthread_mutex_unlock(&shard->lock);
     NOTICE("uc_update: Value too old: name = %s; value time = %.3f; "
            "last cache update = %.3f;",
-           name, CDTIME_T_TO_DOUBLE(vl->time),
-           CDTIME_T_TO_DOUBLE(ce->last_time));
+           name, CDTIME_T_TO_DOUBLE(vl->time), CDTIME_T_TO_DOUBLE(last_time));
     return -1;
   }
 
-  for (size_t i = 0; i < ds->ds_num; i++) {
-    switch (ds->ds[i].type) {
-    case DS_TYPE_COUNTER: {
-      counter_t diff =
-          counter_diff(ce->values_raw[i].counter, vl->values[i].counter);
-      ce->values_gauge[i] =
-          ((double)diff) / (CDTIME_T_TO_DOUBLE(vl->time - ce->last_time));
-      ce->values_raw[i].counter = vl->values[i].counter;
-    } break;
-
-    case DS_TYPE_GAUGE:
-      ce->values_raw[i].gauge = vl->values[i].gauge;
-      ce->values_gauge[i] = vl->values[i].gauge;
-      break;
-
-    case DS_TYPE_DERIVE: {
-      derive_t diff = vl->values[i].derive - ce->values_raw[i].derive;
-
-      ce->values_gauge[i] =
-          ((double)diff) / (CDTIME_T_TO_DOUBLE(vl->time - ce->last_time));
-      ce->values_raw[i].derive = vl->values[i].derive;
-    } break;
-
-    case DS_TYPE_ABSOLUTE:
-      ce->values_gauge[i] = ((double)vl->values[i].absolute) /
-                            (CDTIME_T_TO_DOUBLE(vl->time - ce->last_time));
-      ce->values_raw[i].absolute = vl->values[i].absolute;
-      break;
-
-    default:
-      /* This shouldn't happen. */
-      pthread_mutex_unlock(&cache_lock);
-      ERROR("uc_update: Don't know how to handle data source type %i.",
-            ds->ds[i].type);
-      return -1;
-    } /* switch (ds->ds[i].type) */
-
-    DEBUG("uc_update: %s: ds[%" PRIsz "] = %lf", name, i, ce->values_gauge[i]);
-  } /* for (i) */
-
-  /* Update the history if it exists. */
+  /* All members of value_t have the same size, so comparing the memory also
+   * treats NaN gauges as unchanged. */
+  int ret = 0;
+  if (memcmp(ce->values_raw, vl->values,
+             ce->values_num * sizeof(*ce->values_raw)) != 0)
+    ce->unchanged = 0;
+  else if (ce->unchanged < INT_MAX)
+    ce->unchanged++;
+  if (ce->unchanged > max_unchanged)
+    ce->unchanged = 0; /* pass this one on and start over */
+  else if (ce->unchanged > 0)
+    ret = 1;
+
+  memcpy(ce->values_prev, ce->values_raw,
+         ce->values_num * sizeof(*ce->values_prev));
+  memcpy(ce->values_raw, vl->values, ce->values_num * sizeof(*ce->values_raw));
+  ce->prev_time = ce->last_time;
+  ce->rates_stale = true;
+
+  CE_STORE(ce->last_time, vl->time);
+  CE_STORE(ce->last_update, cdtime_coarse());
+  CE_STORE(ce->interval, vl->interval);
+  wheel_add(shard, ce);
+
+  /* The history records the rate of every update. */
   if (ce->history != NULL) {
-    assert(ce->history_index < ce->history_length);
-    for (size_t i = 0; i < ce->values_num; i++) {
-      size_t hist_idx = (ce->values_num * ce->history_index) + i;
-      ce->history[hist_idx] = ce->values_gauge[i];
-    }
-
-    assert(ce->history_length > 0);
-    ce->history_index = (ce->history_index + 1) % ce->history_length;
+    uc_compute_rates(ce);
+    cache_history_append(ce);
+  }
+  if (ret_rates != NULL) {
+    uc_compute_rates(ce);
+    memcpy(ret_rates, ce->values_gauge, ce->values_num * sizeof(*ret_rates));
   }
-
-  /* Prune invalid gauge data */
-  uc_check_range(ds, ce);
-
-  ce->last_time = vl->time;
-  ce->last_update = cdtime();
-  ce->interval = vl->interval;
 
   /* Check if cache entry has registered callbacks */
   unsigned long callbacks_mask = ce->callbacks_mask;
+  bool restored = ce->restored;
+  ce->restored = false;
+  if (callbacks_mask || restored)
+    sstrncpy(name, ce->name, sizeof(name));
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
-  if (callbacks_mask)
+  if (restored)
+    plugin_dispatch_cache_event(CE_VALUE_NEW, 0 /* mask */, name, vl);
+  else if (callbacks_mask)
     plugin_dispatch_cache_event(CE_VALUE_UPDATE, callbacks_mask, name, vl);
 
-  return 0;
+  return ret;
+} /* int uc_update_changed */
+
+int uc_update(const data_set_t *ds, const value_list_t *vl) {
+  int status = uc_update_changed(ds, vl, /* max_unchanged = */ 0,
+                                 /* ret_rates = */ NULL);
+  return (status < 0) ? status : 0;
 } /* int uc_update */
 
+bool uc_rates_wanted(void) {
+  return __atomic_load_n(&rates_wanted, __ATOMIC_RELAXED);
+} /* bool uc_rates_wanted */
+
 int uc_set_callbacks_mask(const char *name, unsigned long mask) {
-  pthread_mutex_lock(&cache_lock);
-  cache_entry_t *ce = NULL;
-  int status = c_avl_get(cache_tree, name, (void *)&ce);
-  if (status != 0) { /* Ouch, just created entry disappeared ?! */
+  cache_key_t key = cache_key_name(name);
+  cache_shard_t *shard = cache_get_shard(&key);
+  pthread_mutex_lock(&shard->lock);
+  cache_entry_t *ce = cache_lookup(shard, &key);
+  if (ce == NULL) { /* Ouch, just created entry disappeared ?! */
     ERROR("uc_set_callbacks_mask: Couldn't find %s entry!", name);
-    pthread_mutex_unlock(&cache_lock);
+    pthread_mutex_unlock(&shard->lock);
     return -1;
   }
   DEBUG("uc_set_callbacks_mask: set mask for \"%s\" to %lu.", name, mask);
-  ce->callbacks_mask = mask;
-  pthread_mutex_unlock(&cache_lock);
+  CE_STORE(ce->callbacks_mask, mask);
+  pthread_mutex_unlock(&shard->lock);
   return 0;
 }
 
-int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
-                        size_t *ret_values_num) {
+static int uc_get_rate_by_key(cache_key_t const *key,
+                              gauge_t **ret_values, size_t *ret_values_num) {
   gauge_t *ret = NULL;
   size_t ret_num = 0;
   cache_entry_t *ce = NULL;
   int status = 0;
 
-  pthread_mutex_lock(&cache_lock);
-
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
-    assert(ce != NULL);
+  cache_shard_t *shard = cache_get_shard(key);
+  pthread_mutex_lock(&shard->lock);
 
+  if ((ce = cache_lookup(shard, key)) != NULL) {
     /* remove missing values from getval */
     if (ce->state == STATE_MISSING) {
       DEBUG("utils_cache: uc_get_rate_by_name: requested metric \"%s\" is in "
             "state \"missing\".",
-            name);
+            ce->name);
       status = -1;
     } else {
       ret_num = ce->values_num;
@@ -466,15 +1070,17 @@ int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
         ERROR("utils_cache: uc_get_rate_by_name: malloc failed.");
         status = -1;
       } else {
+        uc_compute_rates(ce);
         memcpy(ret, ce->values_gauge, ret_num * sizeof(gauge_t));
       }
     }
   } else {
-    DEBUG("utils_cache: uc_get_rate_by_name: No such value: %s", name);
+    DEBUG("utils_cache: uc_get_rate_by_name: No such value: %s",
+          (key->name != NULL) ? key->name : key->vl->plugin);
     status = -1;
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   if (status == 0) {
     *ret_values = ret;
@@ -482,20 +1088,21 @@ int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
   }
 
   return status;
+} /* int uc_get_rate_by_key */
+
+int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
+                        size_t *ret_values_num) {
+  cache_key_t key = cache_key_name(name);
+  return uc_get_rate_by_key(&key, ret_values, ret_values_num);
 } /* gauge_t *uc_get_rate_by_name */
 
 gauge_t *uc_get_rate(const data_set_t *ds, const value_list_t *vl) {
-  char name[6 * DATA_MAX_NAME_LEN];
+  cache_key_t key = cache_key_vl(vl);
   gauge_t *ret = NULL;
   size_t ret_num = 0;
   int status;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("utils_cache: uc_get_rate: FORMAT_VL failed.");
-    return NULL;
-  }
-
-  status = uc_get_rate_by_name(name, &ret, &ret_num);
+  status = uc_get_rate_by_key(&key, &ret, &ret_num);
   if (status != 0)
     return NULL;
 
@@ -512,18 +1119,31 @@ gauge_t *uc_get_rate(const data_set_t *ds, const value_list_t *vl) {
   return ret;
 } /* gauge_t *uc_get_rate */
 
-int uc_get_value_by_name(const char *name, value_t **ret_values,
-                         size_t *ret_values_num) {
+gauge_t const *uc_get_rate_attached(const data_set_t *ds,
+                                    const value_list_t *vl,
+                                    gauge_t **ret_alloc) {
+  *ret_alloc = NULL;
+  if (vl->rates != NULL)
+    return vl->rates;
+
+  if (!__atomic_load_n(&rates_wanted, __ATOMIC_RELAXED))
+    __atomic_store_n(&rates_wanted, true, __ATOMIC_RELAXED);
+
+  *ret_alloc = uc_get_rate(ds, vl);
+  return *ret_alloc;
+} /* gauge_t const *uc_get_rate_attached */
+
+static int uc_get_value_by_key(cache_key_t const *key, value_t **ret_values,
+                               size_t *ret_values_num) {
   value_t *ret = NULL;
   size_t ret_num = 0;
   cache_entry_t *ce = NULL;
   int status = 0;
 
-  pthread_mutex_lock(&cache_lock);
-
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
-    assert(ce != NULL);
+  cache_shard_t *shard = cache_get_shard(key);
+  pthread_mutex_lock(&shard->lock);
 
+  if ((ce = cache_lookup(shard, key)) != NULL) {
     /* remove missing values from getval */
     if (ce->state == STATE_MISSING) {
       status = -1;
@@ -538,11 +1158,12 @@ int uc_get_value_by_name(const char *name, value_t **ret_values,
       }
     }
   } else {
-    DEBUG("utils_cache: uc_get_value_by_name: No such value: %s", name);
+    DEBUG("utils_cache: uc_get_value_by_name: No such value: %s",
+          (key->name != NULL) ? key->name : key->vl->plugin);
     status = -1;
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   if (status == 0) {
     *ret_values = ret;
@@ -550,20 +1171,21 @@ int uc_get_value_by_name(const char *name, value_t **ret_values,
   }
 
   return (status);
+} /* int uc_get_value_by_key */
+
+int uc_get_value_by_name(const char *name, value_t **ret_values,
+                         size_t *ret_values_num) {
+  cache_key_t key = cache_key_name(name);
+  return uc_get_value_by_key(&key, ret_values, ret_values_num);
 } /* int uc_get_value_by_name */
 
 value_t *uc_get_value(const data_set_t *ds, const value_list_t *vl) {
-  char name[6 * DATA_MAX_NAME_LEN];
+  cache_key_t key = cache_key_vl(vl);
   value_t *ret = NULL;
   size_t ret_num = 0;
   int status;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("utils_cache: uc_get_value: FORMAT_VL failed.");
-    return (NULL);
-  }
-
-  status = uc_get_value_by_name(name, &ret, &ret_num);
+  status = uc_get_value_by_key(&key, &ret, &ret_num);
   if (status != 0)
     return (NULL);
 
@@ -583,18 +1205,18 @@ value_t *uc_get_value(const data_set_t *ds, const value_list_t *vl) {
 size_t uc_get_size(void) {
   size_t size_arrays = 0;
 
-  pthread_mutex_lock(&cache_lock);
-  size_arrays = (size_t)c_avl_size(cache_tree);
-  pthread_mutex_unlock(&cache_lock);
+  for (size_t i = 0; i < UC_SHARDS_NUM; i++) {
+    cache_shard_t *shard = cache_shards + i;
+
+    pthread_mutex_lock(&shard->lock);
+    size_arrays += shard->entries_num;
+    pthread_mutex_unlock(&shard->lock);
+  }
 
   return size_arrays;
 }
 
 int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number) {
-  c_avl_iterator_t *iter;
-  char *key;
-  cache_entry_t *value;
-
   char **names = NULL;
   cdtime_t *times = NULL;
   size_t number = 0;
@@ -605,13 +1227,17 @@ int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number) {
   if ((ret_names == NULL) || (ret_number == NULL))
     return -1;
 
-  pthread_mutex_lock(&cache_lock);
+  uc_snapshot_t *snap = uc_snapshot_acquire();
+  if (snap == NULL) {
+    ERROR("uc_get_names: uc_snapshot_acquire failed.");
+    return ENOMEM;
+  }
 
-  size_arrays = (size_t)c_avl_size(cache_tree);
+  size_arrays = uc_snapshot_size(snap);
   if (size_arrays < 1) {
     /* Handle the "no values" case here, to avoid the error message when
      * calloc() returns NULL. */
-    pthread_mutex_unlock(&cache_lock);
+    uc_snapshot_release(snap);
     return 0;
   }
 
@@ -621,34 +1247,32 @@ int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number) {
     ERROR("uc_get_names: calloc failed.");
     sfree(names);
     sfree(times);
-    pthread_mutex_unlock(&cache_lock);
+    uc_snapshot_release(snap);
     return ENOMEM;
   }
 
-  iter = c_avl_get_iterator(cache_tree);
-  while (c_avl_iterator_next(iter, (void *)&key, (void *)&value) == 0) {
-    /* remove missing values when list values */
-    if (value->state == STATE_MISSING)
+  for (size_t i = 0; i < size_arrays; i++) {
+    uc_snapshot_entry_t value;
+    if (uc_snapshot_get(snap, i, &value) != 0)
       continue;
 
-    /* c_avl_size does not return a number smaller than the number of elements
-     * returned by c_avl_iterator_next. */
-    assert(number < size_arrays);
+    /* remove missing values when list values */
+    if (value.state == STATE_MISSING)
+      continue;
 
     if (ret_times != NULL)
-      times[number] = value->last_time;
+      times[number] = value.time;
 
-    names[number] = strdup(key);
+    names[number] = strdup(value.name);
     if (names[number] == NULL) {
       status = -1;
       break;
     }
 
     number++;
-  } /* while (c_avl_iterator_next) */
+  } /* for (i = 0; i < size_arrays; i++) */
 
-  c_avl_iterator_destroy(iter);
-  pthread_mutex_unlock(&cache_lock);
+  uc_snapshot_release(snap);
 
   if (status != 0) {
     for (size_t i = 0; i < number; i++) {
@@ -671,190 +1295,367 @@ int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number) {
 } /* int uc_get_names */
 
 int uc_get_state(const data_set_t *ds, const value_list_t *vl) {
-  char name[6 * DATA_MAX_NAME_LEN];
+  cache_key_t key = cache_key_vl(vl);
   cache_entry_t *ce = NULL;
   int ret = STATE_ERROR;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("uc_get_state: FORMAT_VL failed.");
-    return STATE_ERROR;
-  }
-
-  pthread_mutex_lock(&cache_lock);
+  cache_shard_t *shard = cache_get_shard(&key);
+  pthread_mutex_lock(&shard->lock);
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
-    assert(ce != NULL);
+  if ((ce = cache_lookup(shard, &key)) != NULL) {
     ret = ce->state;
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return ret;
 } /* int uc_get_state */
 
 int uc_set_state(const data_set_t *ds, const value_list_t *vl, int state) {
-  char name[6 * DATA_MAX_NAME_LEN];
+  cache_key_t key = cache_key_vl(vl);
   cache_entry_t *ce = NULL;
   int ret = -1;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("uc_set_state: FORMAT_VL failed.");
-    return STATE_ERROR;
-  }
-
-  pthread_mutex_lock(&cache_lock);
+  cache_shard_t *shard = cache_get_shard(&key);
+  pthread_mutex_lock(&shard->lock);
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
-    assert(ce != NULL);
+  if ((ce = cache_lookup(shard, &key)) != NULL) {
     ret = ce->state;
-    ce->state = state;
+    CE_STORE(ce->state, state);
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return ret;
 } /* int uc_set_state */
 
-int uc_get_history_by_name(const char *name, gauge_t *ret_history,
-                           size_t num_steps, size_t num_ds) {
+static int uc_get_history_by_key(cache_key_t const *key, gauge_t *ret_history,
+                                size_t num_steps, size_t num_ds) {
   cache_entry_t *ce = NULL;
-  int status = 0;
 
-  pthread_mutex_lock(&cache_lock);
+  cache_shard_t *shard = cache_get_shard(key);
+  pthread_mutex_lock(&shard->lock);
 
-  status = c_avl_get(cache_tree, name, (void *)&ce);
-  if (status != 0) {
-    pthread_mutex_unlock(&cache_lock);
+  ce = cache_lookup(shard, key);
+  if (ce == NULL) {
+    pthread_mutex_unlock(&shard->lock);
     return -ENOENT;
   }
 
   if (((size_t)ce->values_num) != num_ds) {
-    pthread_mutex_unlock(&cache_lock);
+    pthread_mutex_unlock(&shard->lock);
     return -EINVAL;
   }
 
   /* Check if there are enough values available. If not, increase the buffer
-   * size. */
-  if (ce->history_length < num_steps) {
-    gauge_t *tmp;
-
-    tmp =
-        realloc(ce->history, sizeof(*ce->history) * num_steps * ce->values_num);
-    if (tmp == NULL) {
-      pthread_mutex_unlock(&cache_lock);
+   * size. The caller relies on the history, so don't enforce the memory
+   * limit. */
+  if ((ce->history == NULL) || (ce->history->capacity < num_steps)) {
+    if (cache_history_resize(ce, num_steps, /* enforce_limit = */ false) != 0) {
+      pthread_mutex_unlock(&shard->lock);
       return -ENOMEM;
     }
+  }
+
+  /* Copy the values to the output buffer, most recent first. */
+  cache_history_t const *h = ce->history;
+  for (size_t i = 0; i < num_steps; i++) {
+    size_t pos = cache_history_pos(h, i);
 
-    for (size_t i = ce->history_length * ce->values_num;
-         i < (num_steps * ce->values_num); i++)
-      tmp[i] = NAN;
+    for (size_t ds = 0; ds < num_ds; ds++)
+      ret_history[i * num_ds + ds] =
+          (i < h->num) ? h->rates[ds * h->capacity + pos] : NAN;
+  }
 
-    ce->history = tmp;
-    ce->history_length = num_steps;
-  } /* if (ce->history_length < num_steps) */
+  pthread_mutex_unlock(&shard->lock);
 
-  /* Copy the values to the output buffer. */
-  for (size_t i = 0; i < num_steps; i++) {
-    size_t src_index;
-    size_t dst_index;
+  return 0;
+} /* int uc_get_history_by_key */
 
-    if (i < ce->history_index)
-      src_index = ce->history_index - (i + 1);
-    else
-      src_index = ce->history_length + ce->history_index - (i + 1);
-    src_index = src_index * num_ds;
+int uc_get_history_by_name(const char *name, gauge_t *ret_history,
+                           size_t num_steps, size_t num_ds) {
+  cache_key_t key = cache_key_name(name);
+  return uc_get_history_by_key(&key, ret_history, num_steps, num_ds);
+} /* int uc_get_history_by_name */
+
+int uc_get_history_window_by_name(const char *name, size_t max_num,
+                                  cdtime_t **ret_times, gauge_t **ret_rates,
+                                  value_t **ret_values, size_t *ret_num,
+                                  size_t *ret_values_num) {
+  if ((name == NULL) || (ret_num == NULL) || (ret_values_num == NULL))
+    return EINVAL;
 
-    dst_index = i * num_ds;
+  cache_key_t key = cache_key_name(name);
+  cache_shard_t *shard = cache_get_shard(&key);
+  pthread_mutex_lock(&shard->lock);
 
-    memcpy(ret_history + dst_index, ce->history + src_index,
-           sizeof(*ret_history) * num_ds);
+  cache_entry_t *ce = cache_lookup(shard, &key);
+  if (ce == NULL) {
+    pthread_mutex_unlock(&shard->lock);
+    return ENOENT;
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  cache_history_t const *h = ce->history;
+  size_t values_num = ce->values_num;
+  size_t num = (h == NULL) ? 0 : h->num;
+  if ((max_num > 0) && (num > max_num))
+    num = max_num;
 
-  return 0;
-} /* int uc_get_history_by_name */
+  cdtime_t *times = NULL;
+  gauge_t *rates = NULL;
+  value_t *values = NULL;
+  if (num > 0) {
+    times = calloc(num, sizeof(*times));
+    rates = calloc(num * values_num, sizeof(*rates));
+    values = calloc(num * values_num, sizeof(*values));
+    if ((times == NULL) || (rates == NULL) || (values == NULL)) {
+      pthread_mutex_unlock(&shard->lock);
+      ERROR("uc_get_history_window_by_name: calloc failed.");
+      sfree(times);
+      sfree(rates);
+      sfree(values);
+      return ENOMEM;
+    }
+  }
 
-int uc_get_history(const data_set_t *ds, const value_list_t *vl,
-                   gauge_t *ret_history, size_t num_steps, size_t num_ds) {
-  char name[6 * DATA_MAX_NAME_LEN];
+  /* Copy the samples, oldest first. */
+  for (size_t i = 0; i < num; i++) {
+    size_t pos = cache_history_pos(h, num - (i + 1));
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("utils_cache: uc_get_history: FORMAT_VL failed.");
-    return -1;
+    times[i] = h->times[pos];
+    for (size_t ds = 0; ds < values_num; ds++) {
+      rates[i * values_num + ds] = h->rates[ds * h->capacity + pos];
+      values[i * values_num + ds] = h->values[ds * h->capacity + pos];
+    }
   }
 
-  return uc_get_history_by_name(name, ret_history, num_steps, num_ds);
+  pthread_mutex_unlock(&shard->lock);
+
+  if (ret_times != NULL)
+    *ret_times = times;
+  else
+    sfree(times);
+  if (ret_rates != NULL)
+    *ret_rates = rates;
+  else
+    sfree(rates);
+  if (ret_values != NULL)
+    *ret_values = values;
+  else
+    sfree(values);
+  *ret_num = num;
+  *ret_values_num = values_num;
+
+  return 0;
+} /* int uc_get_history_window_by_name */
+
+int uc_get_history(const data_set_t *ds, const value_list_t *vl,
+                   gauge_t *ret_history, size_t num_steps, size_t num_ds) {
+  cache_key_t key = cache_key_vl(vl);
+  return uc_get_history_by_key(&key, ret_history, num_steps, num_ds);
 } /* int uc_get_history */
 
 int uc_get_hits(const data_set_t *ds, const value_list_t *vl) {
-  char name[6 * DATA_MAX_NAME_LEN];
+  cache_key_t key = cache_key_vl(vl);
   cache_entry_t *ce = NULL;
   int ret = STATE_ERROR;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("uc_get_hits: FORMAT_VL failed.");
-    return STATE_ERROR;
-  }
-
-  pthread_mutex_lock(&cache_lock);
+  cache_shard_t *shard = cache_get_shard(&key);
+  pthread_mutex_lock(&shard->lock);
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
-    assert(ce != NULL);
+  if ((ce = cache_lookup(shard, &key)) != NULL) {
     ret = ce->hits;
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return ret;
 } /* int uc_get_hits */
 
 int uc_set_hits(const data_set_t *ds, const value_list_t *vl, int hits) {
-  char name[6 * DATA_MAX_NAME_LEN];
+  cache_key_t key = cache_key_vl(vl);
   cache_entry_t *ce = NULL;
   int ret = -1;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("uc_set_hits: FORMAT_VL failed.");
-    return STATE_ERROR;
-  }
-
-  pthread_mutex_lock(&cache_lock);
+  cache_shard_t *shard = cache_get_shard(&key);
+  pthread_mutex_lock(&shard->lock);
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
-    assert(ce != NULL);
+  if ((ce = cache_lookup(shard, &key)) != NULL) {
     ret = ce->hits;
     ce->hits = hits;
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return ret;
 } /* int uc_set_hits */
 
 int uc_inc_hits(const data_set_t *ds, const value_list_t *vl, int step) {
-  char name[6 * DATA_MAX_NAME_LEN];
+  cache_key_t key = cache_key_vl(vl);
   cache_entry_t *ce = NULL;
   int ret = -1;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("uc_inc_hits: FORMAT_VL failed.");
-    return STATE_ERROR;
-  }
-
-  pthread_mutex_lock(&cache_lock);
+  cache_shard_t *shard = cache_get_shard(&key);
+  pthread_mutex_lock(&shard->lock);
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
-    assert(ce != NULL);
+  if ((ce = cache_lookup(shard, &key)) != NULL) {
     ret = ce->hits;
     ce->hits = ret + step;
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return ret;
 } /* int uc_inc_hits */
 
+int uc_get_threshold(const value_list_t *vl, uint64_t generation,
+                     struct threshold_s **ret_threshold) {
+  cache_key_t key = cache_key_vl(vl);
+  cache_entry_t *ce = NULL;
+  int ret = ENOENT;
+
+  cache_shard_t *shard = cache_get_shard(&key);
+  pthread_mutex_lock(&shard->lock);
+
+  if (((ce = cache_lookup(shard, &key)) != NULL) && (generation != 0) &&
+      (ce->threshold_generation == generation)) {
+    *ret_threshold = ce->threshold;
+    ret = 0;
+  }
+
+  pthread_mutex_unlock(&shard->lock);
+
+  return ret;
+} /* int uc_get_threshold */
+
+int uc_set_threshold(const value_list_t *vl, uint64_t generation,
+                     struct threshold_s *threshold) {
+  cache_key_t key = cache_key_vl(vl);
+  cache_entry_t *ce = NULL;
+  int ret = ENOENT;
+
+  cache_shard_t *shard = cache_get_shard(&key);
+  pthread_mutex_lock(&shard->lock);
+
+  if ((ce = cache_lookup(shard, &key)) != NULL) {
+    ce->threshold = threshold;
+    ce->threshold_generation = generation;
+    ret = 0;
+  }
+
+  pthread_mutex_unlock(&shard->lock);
+
+  return ret;
+} /* int uc_set_threshold */
+
+/*
+ * Snapshot interface
+ */
+uc_snapshot_t *uc_snapshot_acquire(void) {
+  uc_snapshot_t *snap = calloc(1, sizeof(*snap));
+  if (snap == NULL)
+    return NULL;
+
+  for (size_t i = 0; i < UC_SHARDS_NUM; i++) {
+    cache_shard_t *shard = cache_shards + i;
+
+    pthread_mutex_lock(&shard->lock);
+    snap->dirs[i] = cache_dir_get(shard);
+    pthread_mutex_unlock(&shard->lock);
+
+    if (snap->dirs[i] == NULL) {
+      uc_snapshot_release(snap);
+      return NULL;
+    }
+    snap->offsets[i + 1] = snap->offsets[i] + snap->dirs[i]->entries_num;
+  }
+
+  return snap;
+} /* uc_snapshot_t *uc_snapshot_acquire */
+
+void uc_snapshot_release(uc_snapshot_t *snap) {
+  if (snap == NULL)
+    return;
+
+  for (size_t i = 0; i < UC_SHARDS_NUM; i++)
+    cache_dir_unref(snap->dirs[i]);
+  free(snap);
+} /* void uc_snapshot_release */
+
+size_t uc_snapshot_size(uc_snapshot_t const *snap) {
+  if (snap == NULL)
+    return 0;
+  return snap->offsets[UC_SHARDS_NUM];
+} /* size_t uc_snapshot_size */
+
+/* Returns the shard of the snapshot entry at `index', which must be valid. */
+static size_t snapshot_shard(uc_snapshot_t const *snap, size_t index) {
+  /* Find the shard with offsets[shard] <= index < offsets[shard + 1]. */
+  size_t lo = 0;
+  size_t hi = UC_SHARDS_NUM;
+  while ((hi - lo) > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (snap->offsets[mid] <= index)
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  return lo;
+} /* size_t snapshot_shard */
+
+int uc_snapshot_get(uc_snapshot_t const *snap, size_t index,
+                    uc_snapshot_entry_t *ret_entry) {
+  if ((snap == NULL) || (ret_entry == NULL) ||
+      (index >= snap->offsets[UC_SHARDS_NUM]))
+    return EINVAL;
+
+  size_t lo = snapshot_shard(snap, index);
+  cache_entry_t *ce = snap->dirs[lo]->entries[index - snap->offsets[lo]];
+  *ret_entry = (uc_snapshot_entry_t){
+      .name = ce->name,
+      .time = CE_LOAD(ce->last_time),
+      .last_update = CE_LOAD(ce->last_update),
+      .interval = CE_LOAD(ce->interval),
+      .state = CE_LOAD(ce->state),
+      .callbacks_mask = CE_LOAD(ce->callbacks_mask),
+  };
+
+  return 0;
+} /* int uc_snapshot_get */
+
+int uc_snapshot_get_values(uc_snapshot_t const *snap, size_t index,
+                           value_t **ret_values, size_t *ret_values_num,
+                           meta_data_t **ret_meta) {
+  if ((snap == NULL) || (ret_values == NULL) || (ret_values_num == NULL) ||
+      (index >= snap->offsets[UC_SHARDS_NUM]))
+    return EINVAL;
+
+  size_t lo = snapshot_shard(snap, index);
+  cache_entry_t *ce = snap->dirs[lo]->entries[index - snap->offsets[lo]];
+  cache_shard_t *shard = cache_shards + lo;
+  int status = 0;
+
+  pthread_mutex_lock(&shard->lock);
+  if (ce->state == STATE_MISSING) {
+    status = ENOENT;
+  } else {
+    value_t *values = calloc(ce->values_num, sizeof(*values));
+    if (values == NULL) {
+      status = ENOMEM;
+    } else {
+      memcpy(values, ce->values_raw, ce->values_num * sizeof(*values));
+      *ret_values = values;
+      *ret_values_num = ce->values_num;
+      if (ret_meta != NULL)
+        *ret_meta = meta_data_clone(ce->meta);
+    }
+  }
+  pthread_mutex_unlock(&shard->lock);
+
+  return status;
+} /* int uc_snapshot_get_values */
+
 /*
  * Iterator interface
  */
@@ -863,48 +1664,61 @@ uc_iter_t *uc_get_iterator(void) {
   if (iter == NULL)
     return NULL;
 
-  pthread_mutex_lock(&cache_lock);
-
-  iter->iter = c_avl_get_iterator(cache_tree);
-  if (iter->iter == NULL) {
-    free(iter);
-    return NULL;
-  }
+  iter->shard = 0;
+  iter->slot = 0;
+  pthread_mutex_lock(&cache_shards[iter->shard].lock);
+  iter->locked = true;
 
   return iter;
 } /* uc_iter_t *uc_get_iterator */
 
 int uc_iterator_next(uc_iter_t *iter, char **ret_name) {
-  int status;
-
   if (iter == NULL)
     return -1;
 
-  while ((status = c_avl_iterator_next(iter->iter, (void *)&iter->name,
-                                       (void *)&iter->entry)) == 0) {
-    if (iter->entry->state == STATE_MISSING)
-      continue;
+  iter->name = NULL;
+  iter->entry = NULL;
 
-    break;
-  }
-  if (status != 0) {
-    iter->name = NULL;
-    iter->entry = NULL;
-    return -1;
-  }
+  while (iter->locked) {
+    cache_shard_t *shard = cache_shards + iter->shard;
 
-  if (ret_name != NULL)
-    *ret_name = iter->name;
+    while (iter->slot < shard->slots_num) {
+      cache_entry_t *ce = shard->slots[iter->slot];
+      iter->slot++;
 
-  return 0;
+      if ((ce == NULL) || (ce->state == STATE_MISSING))
+        continue;
+
+      iter->name = ce->name;
+      iter->entry = ce;
+      if (ret_name != NULL)
+        *ret_name = iter->name;
+      return 0;
+    }
+
+    /* This shard is exhausted, continue with the next one. */
+    pthread_mutex_unlock(&shard->lock);
+    iter->locked = false;
+
+    iter->shard++;
+    iter->slot = 0;
+    if (iter->shard < UC_SHARDS_NUM) {
+      pthread_mutex_lock(&cache_shards[iter->shard].lock);
+      iter->locked = true;
+    }
+  }
+
+  return -1;
 } /* int uc_iterator_next */
 
 void uc_iterator_destroy(uc_iter_t *iter) {
   if (iter == NULL)
     return;
 
-  c_avl_iterator_destroy(iter->iter);
-  pthread_mutex_unlock(&cache_lock);
+  /* The shard's lock is only still being held if the iterator wasn't run to
+   * completion. */
+  if (iter->locked)
+    pthread_mutex_unlock(&cache_shards[iter->shard].lock);
 
   free(iter);
 } /* void uc_iterator_destroy */
@@ -952,36 +1766,334 @@ int uc_iterator_get_meta(uc_iter_t *iter, meta_data_t **ret_meta) {
 } /* int uc_iterator_get_meta */
 
 /*
- * Meta data interface
+ * Cache file interface
  */
-/* XXX: This function will acquire `cache_lock' but will not free it! */
-static meta_data_t *uc_get_meta(const value_list_t *vl) /* {{{ */
-{
+/* Cache files (see the "CacheFile" option) start with this header, followed
+ * by "records_num" records. Each record is followed by its rates, raw values
+ * and previous raw values, "values_num" of each. Like compiled types
+ * databases, the file is only read by the daemon that wrote it, so it uses
+ * the host's byte order and struct layout, which is checked when loading.
+ * Data set handles are not stable across restarts, so the type is stored by
+ * name. */
+#define UC_FILE_MAGIC "cdcache"
+#define UC_FILE_VERSION 1
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t name_len;    /* sizeof(uc_file_record_t.name) */
+  uint32_t type_len;    /* DATA_MAX_NAME_LEN */
+  uint32_t record_size; /* sizeof(uc_file_record_t) */
+  uint32_t value_size;  /* sizeof(value_t) */
+  uint32_t gauge_size;  /* sizeof(gauge_t) */
+  uint64_t records_num;
+} uc_file_header_t;
+
+typedef struct {
   char name[6 * DATA_MAX_NAME_LEN];
-  cache_entry_t *ce = NULL;
-  int status;
+  char type[DATA_MAX_NAME_LEN];
+  uint64_t last_time;
+  uint64_t prev_time;
+  uint64_t interval;
+  uint32_t values_num;
+  int32_t state;
+} uc_file_record_t;
+
+#define UC_FILE_VALUES_SIZE(values_num)                                        \
+  ((values_num) * (sizeof(gauge_t) + 2 * sizeof(value_t)))
+
+static void uc_file_header_init(uc_file_header_t *hdr) /* {{{ */
+{
+  memset(hdr, 0, sizeof(*hdr));
+  memcpy(hdr->magic, UC_FILE_MAGIC, sizeof(UC_FILE_MAGIC));
+  hdr->version = UC_FILE_VERSION;
+  hdr->name_len = sizeof(((uc_file_record_t *)0)->name);
+  hdr->type_len = DATA_MAX_NAME_LEN;
+  hdr->record_size = sizeof(uc_file_record_t);
+  hdr->value_size = sizeof(value_t);
+  hdr->gauge_size = sizeof(gauge_t);
+} /* }}} void uc_file_header_init */
+
+/* Copies an entry to `rec' and `values', which must have room for
+ * UC_FILE_VALUES_SIZE(ce->values_num) bytes. Returns ENOENT for entries that
+ * are not worth saving. Must hold the shard's lock when calling. */
+static int uc_file_record(cache_entry_t *ce, uc_file_record_t *rec, /* {{{ */
+                          void *values) {
+  if (ce->state == STATE_MISSING)
+    return ENOENT;
+
+  data_set_t const *ds = plugin_get_ds_by_handle(ce->ds_handle);
+  if ((ds == NULL) || (ds->ds_num != ce->values_num))
+    return ENOENT;
+
+  /* Rates are saved, so they are available right after loading. */
+  uc_compute_rates(ce);
+
+  memset(rec, 0, sizeof(*rec));
+  sstrncpy(rec->name, ce->name, sizeof(rec->name));
+  sstrncpy(rec->type, ds->type, sizeof(rec->type));
+  rec->last_time = (uint64_t)ce->last_time;
+  rec->prev_time = (uint64_t)ce->prev_time;
+  rec->interval = (uint64_t)ce->interval;
+  rec->values_num = (uint32_t)ce->values_num;
+  rec->state = (int32_t)ce->state;
+
+  size_t n = ce->values_num;
+  gauge_t *rates = values;
+  value_t *raw = (value_t *)(rates + n);
+  memcpy(rates, ce->values_gauge, n * sizeof(*rates));
+  memcpy(raw, ce->values_raw, n * sizeof(*raw));
+  memcpy(raw + n, ce->values_prev, n * sizeof(*raw));
 
-  status = FORMAT_VL(name, sizeof(name), vl);
-  if (status != 0) {
-    ERROR("utils_cache: uc_get_meta: FORMAT_VL failed.");
-    return NULL;
+  return 0;
+} /* }}} int uc_file_record */
+
+int uc_save_file(char const *file) /* {{{ */
+{
+  if (file == NULL)
+    return EINVAL;
+
+  char tmp_file[PATH_MAX];
+  if ((size_t)snprintf(tmp_file, sizeof(tmp_file), "%s.XXXXXX", file) >=
+      sizeof(tmp_file))
+    return ENAMETOOLONG;
+
+  uc_snapshot_t *snap = uc_snapshot_acquire();
+  if (snap == NULL)
+    return ENOMEM;
+
+  int fd = mkstemp(tmp_file);
+  if (fd < 0) {
+    int status = errno;
+    uc_snapshot_release(snap);
+    return status;
+  }
+
+  FILE *fh = fdopen(fd, "w");
+  if (fh == NULL) {
+    int status = errno;
+    close(fd);
+    unlink(tmp_file);
+    uc_snapshot_release(snap);
+    return status;
+  }
+
+  uc_file_header_t hdr;
+  uc_file_header_init(&hdr);
+
+  /* The header is written again once the number of records is known. */
+  errno = 0;
+  bool ok = (fwrite(&hdr, sizeof(hdr), 1, fh) == 1);
+
+  void *values = NULL;
+  size_t values_size = 0;
+
+  /* Entries are copied one at a time, so each shard is only locked briefly
+   * and the file is written without holding any lock. */
+  for (size_t i = 0; ok && (i < UC_SHARDS_NUM); i++) {
+    cache_shard_t *shard = cache_shards + i;
+    cache_dir_t *dir = snap->dirs[i];
+
+    for (size_t j = 0; ok && (j < dir->entries_num); j++) {
+      cache_entry_t *ce = dir->entries[j];
+      uc_file_record_t rec;
+
+      size_t size = UC_FILE_VALUES_SIZE(ce->values_num);
+      if (size > values_size) {
+        void *tmp = realloc(values, size);
+        if (tmp == NULL) {
+          ok = false;
+          errno = ENOMEM;
+          break;
+        }
+        values = tmp;
+        values_size = size;
+      }
+
+      pthread_mutex_lock(&shard->lock);
+      int status = uc_file_record(ce, &rec, values);
+      pthread_mutex_unlock(&shard->lock);
+      if (status != 0)
+        continue;
+
+      ok = (fwrite(&rec, sizeof(rec), 1, fh) == 1) &&
+           (fwrite(values, size, 1, fh) == 1);
+      hdr.records_num++;
+    }
+  }
+  sfree(values);
+  uc_snapshot_release(snap);
+
+  if (ok)
+    ok = (fseek(fh, 0, SEEK_SET) == 0) &&
+         (fwrite(&hdr, sizeof(hdr), 1, fh) == 1);
+
+  int status = ok ? 0 : ((errno != 0) ? errno : EIO);
+  if ((fclose(fh) != 0) && (status == 0))
+    status = errno;
+  if ((status == 0) && (rename(tmp_file, file) != 0))
+    status = errno;
+
+  if (status != 0)
+    unlink(tmp_file);
+
+  return status;
+} /* }}} int uc_save_file */
+
+/* Adds the entry described by `rec' and `values' unless it is already cached.
+ * Returns zero if the entry has been added. */
+static int uc_file_insert(uc_file_record_t const *rec, /* {{{ */
+                          void const *values) {
+  data_set_t const *ds = plugin_get_ds(rec->type);
+  if ((ds == NULL) || (ds->ds_num != rec->values_num))
+    return ENOENT;
+
+  cache_key_t key = cache_key_name(rec->name);
+  cache_shard_t *shard = cache_get_shard(&key);
+
+  pthread_mutex_lock(&shard->lock);
+  if (cache_lookup(shard, &key) != NULL) {
+    pthread_mutex_unlock(&shard->lock);
+    return EEXIST;
+  }
+
+  cache_entry_t *ce = cache_alloc(ds->ds_num, rec->name);
+  if (ce == NULL) {
+    pthread_mutex_unlock(&shard->lock);
+    return ENOMEM;
   }
 
-  pthread_mutex_lock(&cache_lock);
+  size_t n = ce->values_num;
+  gauge_t const *rates = values;
+  value_t const *raw = (value_t const *)(rates + n);
+
+  ce->hash = key.hash;
+  ce->ds_handle = plugin_get_ds_handle(ds->type);
+  memcpy(ce->values_gauge, rates, n * sizeof(*ce->values_gauge));
+  memcpy(ce->values_raw, raw, n * sizeof(*ce->values_raw));
+  memcpy(ce->values_prev, raw + n, n * sizeof(*ce->values_prev));
+  ce->rates_stale = false;
+  ce->last_time = (cdtime_t)rec->last_time;
+  ce->prev_time = (cdtime_t)rec->prev_time;
+  ce->interval = (cdtime_t)rec->interval;
+  /* The entry gets a full timeout from now, as if it had just been added. */
+  ce->last_update = cdtime_coarse();
+  ce->state = rec->state;
+  ce->restored = true;
+
+  if ((history_length > 0) &&
+      (cache_history_resize(ce, history_length, /* enforce_limit = */ true) ==
+       0))
+    cache_history_append(ce);
+
+  int status = cache_insert(shard, ce);
+  if (status == 0)
+    wheel_add(shard, ce);
+  pthread_mutex_unlock(&shard->lock);
 
-  status = c_avl_get(cache_tree, name, (void *)&ce);
   if (status != 0) {
-    pthread_mutex_unlock(&cache_lock);
+    cache_free(ce);
+    return ENOMEM;
+  }
+  return 0;
+} /* }}} int uc_file_insert */
+
+int uc_load_file(char const *file) /* {{{ */
+{
+  if (file == NULL)
+    return EINVAL;
+
+  int fd = open(file, O_RDONLY);
+  if (fd < 0)
+    return errno;
+
+  struct stat st;
+  if ((fstat(fd, &st) != 0) ||
+      ((size_t)st.st_size < sizeof(uc_file_header_t))) {
+    close(fd);
+    return EINVAL;
+  }
+
+  size_t size = (size_t)st.st_size;
+  char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return errno;
+
+  /* The whole file is read sequentially, exactly once. */
+  madvise(map, size, MADV_SEQUENTIAL);
+
+  uc_file_header_t want;
+  uc_file_header_init(&want);
+
+  uc_file_header_t const *hdr = (void *)map;
+  if ((memcmp(hdr->magic, want.magic, sizeof(want.magic)) != 0) ||
+      (hdr->version != want.version) || (hdr->name_len != want.name_len) ||
+      (hdr->type_len != want.type_len) ||
+      (hdr->record_size != want.record_size) ||
+      (hdr->value_size != want.value_size) ||
+      (hdr->gauge_size != want.gauge_size)) {
+    munmap(map, size);
+    return EINVAL;
+  }
+
+  uint64_t loaded = 0;
+  uint64_t skipped = 0;
+  int status = 0;
+
+  size_t pos = sizeof(*hdr);
+  for (uint64_t i = 0; i < hdr->records_num; i++) {
+    uc_file_record_t const *rec = (void *)(map + pos);
+    if ((size - pos) < sizeof(*rec) || (rec->values_num == 0) ||
+        (rec->values_num >
+         (size - pos - sizeof(*rec)) / UC_FILE_VALUES_SIZE(1)) ||
+        (strnlen(rec->name, sizeof(rec->name)) >= sizeof(rec->name)) ||
+        (strnlen(rec->type, sizeof(rec->type)) >= sizeof(rec->type))) {
+      status = EINVAL;
+      break;
+    }
+
+    if (uc_file_insert(rec, rec + 1) == 0)
+      loaded++;
+    else
+      skipped++;
+
+    pos += sizeof(*rec) + UC_FILE_VALUES_SIZE(rec->values_num);
+  }
+
+  munmap(map, size);
+
+  INFO("uc_load_file: Loaded %" PRIu64 " entries from `%s', skipped %" PRIu64
+       ".",
+       loaded, file, skipped);
+  return status;
+} /* }}} int uc_load_file */
+
+/*
+ * Meta data interface
+ */
+/* XXX: This function will acquire the lock of the value list's shard but will
+ * not free it! The shard is returned in `ret_shard'. */
+static meta_data_t *uc_get_meta(const value_list_t *vl, /* {{{ */
+                                cache_shard_t **ret_shard) {
+  cache_key_t key = cache_key_vl(vl);
+
+  cache_shard_t *shard = cache_get_shard(&key);
+  pthread_mutex_lock(&shard->lock);
+
+  cache_entry_t *ce = cache_lookup(shard, &key);
+  if (ce == NULL) {
+    pthread_mutex_unlock(&shard->lock);
     return NULL;
   }
-  assert(ce != NULL);
 
   if (ce->meta == NULL)
     ce->meta = meta_data_create();
 
   if (ce->meta == NULL)
-    pthread_mutex_unlock(&cache_lock);
+    pthread_mutex_unlock(&shard->lock);
 
+  *ret_shard = shard;
   return ce->meta;
 } /* }}} meta_data_t *uc_get_meta */
 
@@ -989,13 +2101,14 @@ static meta_data_t *uc_get_meta(const value_list_t *vl) /* {{{ */
  * shorter.. */
 #define UC_WRAP(wrap_function)                                                 \
   {                                                                            \
+    cache_shard_t *shard;                                                      \
     meta_data_t *meta;                                                         \
     int status;                                                                \
-    meta = uc_get_meta(vl);                                                    \
+    meta = uc_get_meta(vl, &shard);                                            \
     if (meta == NULL)                                                          \
       return -1;                                                               \
     status = wrap_function(meta, key);                                         \
-    pthread_mutex_unlock(&cache_lock);                                         \
+    pthread_mutex_unlock(&shard->lock);                                        \
     return status;                                                             \
   }
 int uc_meta_data_exists(const value_list_t *vl, const char *key)
@@ -1015,13 +2128,14 @@ int uc_meta_data_exists(const value_list_t *vl, const char *key)
  * two argumetns. */
 #define UC_WRAP(wrap_function)                                                 \
   {                                                                            \
+    cache_shard_t *shard;                                                      \
     meta_data_t *meta;                                                         \
     int status;                                                                \
-    meta = uc_get_meta(vl);                                                    \
+    meta = uc_get_meta(vl, &shard);                                            \
     if (meta == NULL)                                                          \
       return -1;                                                               \
     status = wrap_function(meta, key, value);                                  \
-    pthread_mutex_unlock(&cache_lock);                                         \
+    pthread_mutex_unlock(&shard->lock);                                        \
     return status;                                                             \
   }
         int uc_meta_data_add_string(const value_list_t *vl, const char *key,
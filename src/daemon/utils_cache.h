@@ -40,9 +40,27 @@
 int uc_init(void);
 int uc_check_timeout(void);
 int uc_update(const data_set_t *ds, const value_list_t *vl);
+/* Like uc_update(), but returns 1 instead of 0 if the values are the same as
+ * in the previous update and this happened fewer than `max_unchanged' times in
+ * a row. The cache entry is refreshed either way, so the value does not time
+ * out while its writes are suppressed. If `ret_rates' is not NULL, the rates
+ * of the update are computed right away and copied to it, unless an error is
+ * returned. */
+int uc_update_changed(const data_set_t *ds, const value_list_t *vl,
+                      int max_unchanged, gauge_t *ret_rates);
+/* Returns true once a writer has asked for rates that were not attached to its
+ * value list, i.e. computing rates in uc_update_changed() saves lookups. */
+bool uc_rates_wanted(void);
 int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
                         size_t *ret_values_num);
 gauge_t *uc_get_rate(const data_set_t *ds, const value_list_t *vl);
+/* Returns the rates of `vl'. If they were attached when `vl' was dispatched,
+ * this takes no lock and allocates nothing. Otherwise they are looked up like
+ * with uc_get_rate() and `*ret_alloc' is set to the returned array, which the
+ * caller must free. Returns NULL on failure. */
+gauge_t const *uc_get_rate_attached(const data_set_t *ds,
+                                    const value_list_t *vl,
+                                    gauge_t **ret_alloc);
 int uc_get_value_by_name(const char *name, value_t **ret_values,
                          size_t *ret_values_num);
 value_t *uc_get_value(const data_set_t *ds, const value_list_t *vl);
@@ -58,11 +76,160 @@ int uc_inc_hits(const data_set_t *ds, const value_list_t *vl, int step);
 
 int uc_set_callbacks_mask(const char *name, unsigned long callbacks_mask);
 
+/*
+ * NAME
+ *   uc_get_threshold, uc_set_threshold
+ *
+ * DESCRIPTION
+ *   Cache the result of a threshold search (see utils_threshold.h) in the
+ *   value's cache entry. `threshold' may be NULL to record that no threshold
+ *   matches. A cached result is only returned if it was stored with the same
+ *   non-zero `generation', so bumping the generation invalidates all cached
+ *   results.
+ *
+ * RETURN VALUE
+ *   Zero upon success, ENOENT if there is no such value or, for
+ *   uc_get_threshold, no result has been cached for this generation.
+ */
+struct threshold_s;
+int uc_get_threshold(const value_list_t *vl, uint64_t generation,
+                     struct threshold_s **ret_threshold);
+int uc_set_threshold(const value_list_t *vl, uint64_t generation,
+                     struct threshold_s *threshold);
+
 int uc_get_history(const data_set_t *ds, const value_list_t *vl,
                    gauge_t *ret_history, size_t num_steps, size_t num_ds);
 int uc_get_history_by_name(const char *name, gauge_t *ret_history,
                            size_t num_steps, size_t num_ds);
 
+/*
+ * NAME
+ *   uc_get_history_window_by_name
+ *
+ * DESCRIPTION
+ *   Copy up to `max_num' (zero means all) of the most recent samples stored in
+ *   the history of `name', oldest first. For each sample, its time and the
+ *   rate and raw value of each data source are returned. Rates and values are
+ *   stored row by row, i.e. data source `ds' of sample `i' is at index
+ *   `i * *ret_values_num + ds'. Each of `ret_times', `ret_rates' and
+ *   `ret_values' may be NULL; the others are allocated and must be freed by
+ *   the caller.
+ *
+ *   Samples are kept for all metrics if the global "CacheHistoryLength" option
+ *   is set, and for metrics queried with uc_get_history.
+ *
+ * RETURN VALUE
+ *   Zero upon success (possibly with zero samples), ENOENT if there is no such
+ *   metric or another error code else.
+ */
+int uc_get_history_window_by_name(const char *name, size_t max_num,
+                                  cdtime_t **ret_times, gauge_t **ret_rates,
+                                  value_t **ret_values, size_t *ret_num,
+                                  size_t *ret_values_num);
+
+/*
+ * Snapshot interface
+ */
+struct uc_snapshot_s;
+typedef struct uc_snapshot_s uc_snapshot_t;
+
+typedef struct {
+  /* Valid until the snapshot is released. */
+  const char *name;
+  cdtime_t time;
+  cdtime_t last_update;
+  cdtime_t interval;
+  int state;
+  unsigned long callbacks_mask;
+} uc_snapshot_entry_t;
+
+/*
+ * NAME
+ *   uc_snapshot_acquire
+ *
+ * DESCRIPTION
+ *   Create a read-only snapshot of the cache's entries. The set of entries is
+ *   fixed when the snapshot is created, while their time, interval and state
+ *   keep being updated. Walking a snapshot does not take any lock, so it does
+ *   not block updates of the cache. Entries removed from the cache in the
+ *   meantime stay accessible until the snapshot is released.
+ *
+ * RETURN VALUE
+ *   A snapshot object on success or NULL else. It must be released with
+ *   uc_snapshot_release.
+ */
+uc_snapshot_t *uc_snapshot_acquire(void);
+void uc_snapshot_release(uc_snapshot_t *snap);
+
+/* Returns the number of entries in the snapshot. */
+size_t uc_snapshot_size(uc_snapshot_t const *snap);
+
+/*
+ * NAME
+ *   uc_snapshot_get
+ *
+ * DESCRIPTION
+ *   Copy the entry at position `index' (less than uc_snapshot_size) of the
+ *   snapshot to `ret_entry'.
+ *
+ * RETURN VALUE
+ *   Zero upon success or EINVAL if the index is out of range.
+ */
+int uc_snapshot_get(uc_snapshot_t const *snap, size_t index,
+                    uc_snapshot_entry_t *ret_entry);
+
+/*
+ * NAME
+ *   uc_snapshot_get_values
+ *
+ * DESCRIPTION
+ *   Copy the raw values and, if `ret_meta' is not NULL, the meta data of the
+ *   entry at position `index'. Only the lock of the entry's cache partition is
+ *   taken. The returned values must be freed, the meta data destroyed by the
+ *   caller.
+ *
+ * RETURN VALUE
+ *   Zero upon success, ENOENT if the entry is missing, EINVAL or ENOMEM else.
+ */
+int uc_snapshot_get_values(uc_snapshot_t const *snap, size_t index,
+                           value_t **ret_values, size_t *ret_values_num,
+                           meta_data_t **ret_meta);
+
+/*
+ * Cache file interface
+ */
+/*
+ * NAME
+ *   uc_save_file
+ *
+ * DESCRIPTION
+ *   Write the identifier, raw values of the last two updates, rates, times and
+ *   interval of every entry to `file', so that a restarted daemon can compute
+ *   rates from the first update on (see the "CacheFile" option). The file is
+ *   replaced atomically. Meta data and history are not saved.
+ *
+ * RETURN VALUE
+ *   Zero upon success or an errno value else.
+ */
+int uc_save_file(char const *file);
+
+/*
+ * NAME
+ *   uc_load_file
+ *
+ * DESCRIPTION
+ *   Add the entries saved by uc_save_file to the cache. Entries that are
+ *   already cached, and entries whose type is no longer known or has a
+ *   different number of data sources, are skipped. Loaded entries time out
+ *   like new ones.
+ *
+ * RETURN VALUE
+ *   Zero upon success, ENOENT if the file does not exist, EINVAL if it was
+ *   written by an incompatible daemon or is broken, or another errno value.
+ *   Entries before a broken record are loaded.
+ */
+int uc_load_file(char const *file);
+
 /*
  * Iterator interface
  */
@@ -74,8 +241,10 @@ typedef struct uc_iter_s uc_iter_t;
  *   uc_get_iterator
  *
  * DESCRIPTION
- *   Create an iterator for the cache. It will hold the cache lock until it's
- *   destroyed.
+ *   Create an iterator for the cache. While iterating, it holds the lock of
+ *   the cache partition the current entry belongs to; updates of other
+ *   partitions are not blocked. Prefer uc_snapshot_acquire if the values and
+ *   meta data are not needed.
  *
  * RETURN VALUE
  *   An iterator object on success or NULL else.
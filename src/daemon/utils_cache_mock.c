@@ -35,6 +35,15 @@ gauge_t *uc_get_rate(__attribute__((unused)) data_set_t const *ds,
   return NULL;
 }
 
+gauge_t const *uc_get_rate_attached(data_set_t const *ds,
+                                    value_list_t const *vl,
+                                    gauge_t **ret_alloc) {
+  *ret_alloc = NULL;
+  if (vl->rates != NULL)
+    return vl->rates;
+  return *ret_alloc = uc_get_rate(ds, vl);
+}
+
 int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
                         size_t *ret_values_num) {
   return ENOTSUP;
@@ -44,6 +53,38 @@ int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number) {
   return ENOTSUP;
 }
 
+uc_snapshot_t *uc_snapshot_acquire(void) {
+  errno = ENOTSUP;
+  return NULL;
+}
+
+void uc_snapshot_release(__attribute__((unused)) uc_snapshot_t *snap) {}
+
+size_t uc_snapshot_size(__attribute__((unused)) uc_snapshot_t const *snap) {
+  return 0;
+}
+
+int uc_snapshot_get(__attribute__((unused)) uc_snapshot_t const *snap,
+                    __attribute__((unused)) size_t index,
+                    __attribute__((unused)) uc_snapshot_entry_t *ret_entry) {
+  return EINVAL;
+}
+
+int uc_snapshot_get_values(__attribute__((unused)) uc_snapshot_t const *snap,
+                           __attribute__((unused)) size_t index,
+                           __attribute__((unused)) value_t **ret_values,
+                           __attribute__((unused)) size_t *ret_values_num,
+                           __attribute__((unused)) meta_data_t **ret_meta) {
+  return EINVAL;
+}
+
+int uc_get_history_window_by_name(const char *name, size_t max_num,
+                                  cdtime_t **ret_times, gauge_t **ret_rates,
+                                  value_t **ret_values, size_t *ret_num,
+                                  size_t *ret_values_num) {
+  return ENOTSUP;
+}
+
 int uc_get_value_by_name(const char *name, value_t **ret_values,
                          size_t *ret_values_num) {
   return ENOTSUP;
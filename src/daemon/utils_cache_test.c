@@ -0,0 +1,549 @@
+/**
+ * collectd - src/daemon/utils_cache_test.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "collectd.h"
+#include "utils/common/common.h"
+
+#include "testing.h"
+#include "utils_cache.h"
+
+#if HAVE_KSTAT_H
+#include <kstat.h>
+#endif
+
+#if HAVE_LIBKSTAT
+kstat_ctl_t *kc;
+#endif /* HAVE_LIBKSTAT */
+
+/* Usually defined in globals.c. */
+int timeout_g = 2;
+
+#define HISTORY_LENGTH 4
+
+/* Usually defined in configfile.c. */
+const char *global_option_get(const char *option) {
+  if (strcasecmp("CacheHistoryLength", option) == 0)
+    return "4"; /* HISTORY_LENGTH */
+  return NULL;
+}
+
+/* Enough value lists to make every shard grow a couple of times. */
+#define VALUES_NUM 4096
+
+static data_source_t dsrc_gauge = {"value", DS_TYPE_GAUGE, NAN, NAN};
+static data_set_t ds_gauge = {"gauge", 1, &dsrc_gauge};
+
+static void fill_vl(value_list_t *vl, value_t *value, int i) {
+  *vl = (value_list_t){
+      .values = value,
+      .values_len = 1,
+      .time = TIME_T_TO_CDTIME_T(1),
+      /* Every other value list has no interval and expires on the first
+       * uc_check_timeout() call. */
+      .interval = (i % 2) ? TIME_T_TO_CDTIME_T(10) : 0,
+  };
+  value->gauge = (gauge_t)i;
+  sstrncpy(vl->host, "example.com", sizeof(vl->host));
+  sstrncpy(vl->plugin, "test", sizeof(vl->plugin));
+  snprintf(vl->plugin_instance, sizeof(vl->plugin_instance), "%d", i % 7);
+  sstrncpy(vl->type, "gauge", sizeof(vl->type));
+  snprintf(vl->type_instance, sizeof(vl->type_instance), "%d", i);
+}
+
+static size_t count_iterator(void) {
+  size_t num = 0;
+  uc_iter_t *iter = uc_get_iterator();
+  char *name = NULL;
+
+  while (uc_iterator_next(iter, &name) == 0) {
+    cdtime_t t = 0;
+    CHECK_ZERO(uc_iterator_get_time(iter, &t));
+    EXPECT_EQ_UINT64(TIME_T_TO_CDTIME_T(1), t);
+    num++;
+  }
+  uc_iterator_destroy(iter);
+
+  return num;
+}
+
+DEF_TEST(cache) {
+  value_list_t vl;
+  value_t value;
+
+  CHECK_ZERO(uc_init());
+
+  for (int i = 0; i < VALUES_NUM; i++) {
+    fill_vl(&vl, &value, i);
+    CHECK_ZERO(uc_update(&ds_gauge, &vl));
+  }
+  EXPECT_EQ_UINT64(VALUES_NUM, uc_get_size());
+  EXPECT_EQ_UINT64(VALUES_NUM, count_iterator());
+
+  /* An update with the same time is rejected. */
+  fill_vl(&vl, &value, 42);
+  EXPECT_EQ_INT(-1, uc_update(&ds_gauge, &vl));
+
+  /* Look up by value list and by name. */
+  for (int i = 0; i < VALUES_NUM; i++) {
+    char name[6 * DATA_MAX_NAME_LEN];
+    gauge_t *rates = NULL;
+    size_t rates_num = 0;
+
+    fill_vl(&vl, &value, i);
+    CHECK_NOT_NULL(rates = uc_get_rate(&ds_gauge, &vl));
+    EXPECT_EQ_DOUBLE((gauge_t)i, rates[0]);
+    sfree(rates);
+
+    CHECK_ZERO(FORMAT_VL(name, sizeof(name), &vl));
+    CHECK_ZERO(uc_get_rate_by_name(name, &rates, &rates_num));
+    EXPECT_EQ_UINT64(1, rates_num);
+    EXPECT_EQ_DOUBLE((gauge_t)i, rates[0]);
+    sfree(rates);
+  }
+
+  /* Similar identifiers must not match. */
+  gauge_t *rates = NULL;
+  size_t rates_num = 0;
+  EXPECT_EQ_INT(-1, uc_get_rate_by_name("example.com/test-1/gauge-", &rates,
+                                        &rates_num));
+  EXPECT_EQ_INT(-1, uc_get_rate_by_name("example.com/test-1/gauge-1-", &rates,
+                                        &rates_num));
+  fill_vl(&vl, &value, 1);
+  sstrncpy(vl.type_instance, "", sizeof(vl.type_instance));
+  EXPECT_EQ_PTR(NULL, uc_get_rate(&ds_gauge, &vl));
+
+  /* Remove every other entry, then make sure the remaining ones can still be
+   * found. Entries in a snapshot must stay valid until it is released. */
+  uc_snapshot_t *snap;
+  CHECK_NOT_NULL(snap = uc_snapshot_acquire());
+  EXPECT_EQ_UINT64(VALUES_NUM, uc_snapshot_size(snap));
+
+  CHECK_ZERO(uc_check_timeout());
+
+  EXPECT_EQ_UINT64(VALUES_NUM, uc_snapshot_size(snap));
+  for (size_t i = 0; i < uc_snapshot_size(snap); i++) {
+    uc_snapshot_entry_t entry;
+    CHECK_ZERO(uc_snapshot_get(snap, i, &entry));
+    EXPECT_EQ_INT(0, strncmp("example.com/test-", entry.name, 17));
+    EXPECT_EQ_UINT64(TIME_T_TO_CDTIME_T(1), entry.time);
+
+    value_t *values = NULL;
+    size_t values_num = 0;
+    CHECK_ZERO(uc_snapshot_get_values(snap, i, &values, &values_num, NULL));
+    EXPECT_EQ_UINT64(1, values_num);
+    const char *type_instance = strrchr(entry.name, '-') + 1;
+    EXPECT_EQ_DOUBLE((gauge_t)atoi(type_instance), values[0].gauge);
+    sfree(values);
+  }
+  uc_snapshot_entry_t entry;
+  EXPECT_EQ_INT(EINVAL, uc_snapshot_get(snap, VALUES_NUM, &entry));
+  value_t *values = NULL;
+  size_t values_num = 0;
+  EXPECT_EQ_INT(EINVAL, uc_snapshot_get_values(snap, VALUES_NUM, &values,
+                                               &values_num, NULL));
+  uc_snapshot_release(snap);
+
+  EXPECT_EQ_UINT64(VALUES_NUM / 2, uc_get_size());
+  EXPECT_EQ_UINT64(VALUES_NUM / 2, count_iterator());
+
+  for (int i = 0; i < VALUES_NUM; i++) {
+    fill_vl(&vl, &value, i);
+    gauge_t *rates = uc_get_rate(&ds_gauge, &vl);
+    if (i % 2) {
+      CHECK_NOT_NULL(rates);
+      EXPECT_EQ_DOUBLE((gauge_t)i, rates[0]);
+    } else {
+      EXPECT_EQ_PTR(NULL, rates);
+    }
+    sfree(rates);
+  }
+
+  char **names = NULL;
+  cdtime_t *times = NULL;
+  size_t names_num = 0;
+  CHECK_ZERO(uc_get_names(&names, &times, &names_num));
+  EXPECT_EQ_UINT64(VALUES_NUM / 2, names_num);
+  for (size_t i = 0; i < names_num; i++) {
+    EXPECT_EQ_UINT64(TIME_T_TO_CDTIME_T(1), times[i]);
+    sfree(names[i]);
+  }
+  sfree(names);
+  sfree(times);
+
+  return 0;
+}
+
+DEF_TEST(history) {
+  value_list_t vl;
+  value_t value;
+  char name[6 * DATA_MAX_NAME_LEN];
+
+  CHECK_ZERO(uc_init());
+
+  fill_vl(&vl, &value, 1);
+  sstrncpy(vl.type_instance, "history", sizeof(vl.type_instance));
+  CHECK_ZERO(FORMAT_VL(name, sizeof(name), &vl));
+
+  /* Write more samples than the window holds. */
+  for (int i = 0; i < HISTORY_LENGTH + 2; i++) {
+    vl.time = TIME_T_TO_CDTIME_T(100 + i);
+    value.gauge = (gauge_t)i;
+    CHECK_ZERO(uc_update(&ds_gauge, &vl));
+  }
+
+  cdtime_t *times = NULL;
+  gauge_t *rates = NULL;
+  value_t *values = NULL;
+  size_t num = 0;
+  size_t values_num = 0;
+  CHECK_ZERO(uc_get_history_window_by_name(name, 0, &times, &rates, &values,
+                                           &num, &values_num));
+  EXPECT_EQ_UINT64(HISTORY_LENGTH, num);
+  EXPECT_EQ_UINT64(1, values_num);
+  for (size_t i = 0; i < num; i++) {
+    /* Oldest first; the first two samples have been overwritten. */
+    EXPECT_EQ_UINT64(TIME_T_TO_CDTIME_T(102 + i), times[i]);
+    EXPECT_EQ_DOUBLE((gauge_t)(2 + i), rates[i]);
+    EXPECT_EQ_DOUBLE((gauge_t)(2 + i), values[i].gauge);
+  }
+  sfree(times);
+  sfree(rates);
+  sfree(values);
+
+  /* Limit the window to the most recent samples. */
+  CHECK_ZERO(uc_get_history_window_by_name(name, 2, &times, &rates, NULL, &num,
+                                           &values_num));
+  EXPECT_EQ_UINT64(2, num);
+  EXPECT_EQ_UINT64(TIME_T_TO_CDTIME_T(104), times[0]);
+  EXPECT_EQ_DOUBLE(5.0, rates[1]);
+  sfree(times);
+  sfree(rates);
+
+  /* uc_get_history() returns the most recent sample first and pads with NaN
+   * when more steps are requested than have been recorded. */
+  gauge_t history[HISTORY_LENGTH + 2];
+  CHECK_ZERO(uc_get_history(&ds_gauge, &vl, history, HISTORY_LENGTH + 2, 1));
+  EXPECT_EQ_DOUBLE(5.0, history[0]);
+  EXPECT_EQ_DOUBLE(2.0, history[HISTORY_LENGTH - 1]);
+  OK(isnan(history[HISTORY_LENGTH]));
+
+  EXPECT_EQ_INT(ENOENT,
+                uc_get_history_window_by_name("example.com/test/gauge-none", 0,
+                                              &times, &rates, NULL, &num,
+                                              &values_num));
+
+  return 0;
+}
+
+/* The mock's "MAGIC" type has one derive data source with a minimum of 0. */
+DEF_TEST(rate) {
+  data_set_t const *ds = plugin_get_ds("MAGIC");
+  value_list_t vl;
+  value_t value;
+  char name[6 * DATA_MAX_NAME_LEN];
+
+  CHECK_ZERO(uc_init());
+
+  fill_vl(&vl, &value, 1);
+  sstrncpy(vl.type, "MAGIC", sizeof(vl.type));
+  CHECK_ZERO(FORMAT_VL(name, sizeof(name), &vl));
+
+  struct {
+    int time;
+    derive_t value;
+    gauge_t want_rate;
+  } cases[] = {
+      {10, 100, NAN}, /* first value, no rate yet */
+      {20, 200, 10.0},
+      {25, 250, 10.0},
+      {30, 200, NAN}, /* below the minimum */
+      {40, 600, 40.0},
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    vl.time = TIME_T_TO_CDTIME_T(cases[i].time);
+    value.derive = cases[i].value;
+    CHECK_ZERO(uc_update(ds, &vl));
+
+    gauge_t *rates = NULL;
+    size_t rates_num = 0;
+    CHECK_NOT_NULL(rates = uc_get_rate(ds, &vl));
+    EXPECT_EQ_DOUBLE(cases[i].want_rate, rates[0]);
+    sfree(rates);
+
+    /* Reading the rate again, and by name, returns the same value. */
+    CHECK_ZERO(uc_get_rate_by_name(name, &rates, &rates_num));
+    EXPECT_EQ_UINT64(1, rates_num);
+    EXPECT_EQ_DOUBLE(cases[i].want_rate, rates[0]);
+    sfree(rates);
+  }
+
+  /* The raw value is stored as is. */
+  value_t *values = uc_get_value(ds, &vl);
+  CHECK_NOT_NULL(values);
+  EXPECT_EQ_INT(600, (int)values[0].derive);
+  sfree(values);
+
+  /* Rates are only attached by the dispatch path once a writer asked for
+   * them. */
+  EXPECT_EQ_INT(0, uc_rates_wanted());
+  gauge_t *alloc = NULL;
+  gauge_t const *got = uc_get_rate_attached(ds, &vl, &alloc);
+  OK(got != NULL);
+  EXPECT_EQ_DOUBLE(40.0, got[0]);
+  OK(got == alloc);
+  sfree(alloc);
+  EXPECT_EQ_INT(1, uc_rates_wanted());
+
+  /* Rates computed by the update are the ones uc_get_rate() returns. */
+  gauge_t rate = 0;
+  vl.time = TIME_T_TO_CDTIME_T(50);
+  value.derive = 700;
+  CHECK_ZERO(uc_update_changed(ds, &vl, 0, &rate));
+  EXPECT_EQ_DOUBLE(10.0, rate);
+
+  vl.rates = &rate;
+  got = uc_get_rate_attached(ds, &vl, &alloc);
+  OK(got == &rate);
+  OK(alloc == NULL);
+
+  /* New entries get the rates of their first value. */
+  sstrncpy(vl.plugin, "attached", sizeof(vl.plugin));
+  CHECK_ZERO(uc_update_changed(ds, &vl, 0, &rate));
+  EXPECT_EQ_DOUBLE(NAN, rate);
+
+  return 0;
+}
+
+DEF_TEST(update_changed) {
+  value_list_t vl;
+  value_t value;
+
+  CHECK_ZERO(uc_init());
+
+  fill_vl(&vl, &value, 1);
+  sstrncpy(vl.plugin, "unchanged", sizeof(vl.plugin));
+
+  struct {
+    gauge_t value;
+    int want;
+  } cases[] = {
+      {1.0, 0}, /* new entry */
+      {1.0, 1}, {1.0, 1},
+      {1.0, 0}, /* suppressed twice, pass it on */
+      {1.0, 1}, {2.0, 0}, {2.0, 1}, {NAN, 0}, {NAN, 1},
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    vl.time = TIME_T_TO_CDTIME_T(10 + i);
+    value.gauge = cases[i].value;
+    EXPECT_EQ_INT(cases[i].want, uc_update_changed(&ds_gauge, &vl, 2, NULL));
+
+    /* Suppressed updates are stored, too. */
+    EXPECT_EQ_INT(-1, uc_update_changed(&ds_gauge, &vl, 2, NULL));
+  }
+
+  /* Without a limit, nothing is suppressed. */
+  vl.time = TIME_T_TO_CDTIME_T(100);
+  EXPECT_EQ_INT(0, uc_update_changed(&ds_gauge, &vl, 0, NULL));
+
+  return 0;
+}
+
+/* Defined in utils_time.c when built with MOCK_TIME. */
+extern cdtime_t cdtime_mock;
+
+DEF_TEST(timeout) {
+  value_list_t vl;
+  value_t value;
+
+  CHECK_ZERO(uc_init());
+
+  /* One interval for each level of the timer wheel, and one beyond. */
+  cdtime_t intervals[] = {
+      TIME_T_TO_CDTIME_T(1),
+      TIME_T_TO_CDTIME_T(100),
+      TIME_T_TO_CDTIME_T(10000),
+      TIME_T_TO_CDTIME_T(1000000),
+  };
+  size_t intervals_num = STATIC_ARRAY_SIZE(intervals);
+
+  cdtime_t start = cdtime_mock;
+  for (size_t i = 0; i < intervals_num; i++) {
+    fill_vl(&vl, &value, (int)i);
+    sstrncpy(vl.plugin, "timeout", sizeof(vl.plugin));
+    vl.interval = intervals[i];
+    CHECK_ZERO(uc_update(&ds_gauge, &vl));
+  }
+
+  /* Entries time out after twice their interval, see timeout_g. */
+  for (size_t i = 0; i < intervals_num; i++) {
+    cdtime_mock = start + 2 * intervals[i] - TIME_T_TO_CDTIME_T(1);
+    CHECK_ZERO(uc_check_timeout());
+    for (size_t j = 0; j < intervals_num; j++) {
+      fill_vl(&vl, &value, (int)j);
+      sstrncpy(vl.plugin, "timeout", sizeof(vl.plugin));
+      gauge_t *rates = uc_get_rate(&ds_gauge, &vl);
+      EXPECT_EQ_INT(j >= i, (int)(rates != NULL));
+      sfree(rates);
+    }
+
+    cdtime_mock += TIME_T_TO_CDTIME_T(2);
+    CHECK_ZERO(uc_check_timeout());
+    fill_vl(&vl, &value, (int)i);
+    sstrncpy(vl.plugin, "timeout", sizeof(vl.plugin));
+    EXPECT_EQ_PTR(NULL, uc_get_rate(&ds_gauge, &vl));
+  }
+
+  /* Updates move the deadline. */
+  start = cdtime_mock;
+  vl.interval = TIME_T_TO_CDTIME_T(10);
+  CHECK_ZERO(uc_update(&ds_gauge, &vl));
+  cdtime_mock = start + TIME_T_TO_CDTIME_T(15);
+  vl.time += TIME_T_TO_CDTIME_T(1);
+  CHECK_ZERO(uc_update(&ds_gauge, &vl));
+
+  cdtime_mock = start + TIME_T_TO_CDTIME_T(25);
+  CHECK_ZERO(uc_check_timeout());
+  gauge_t *rates = uc_get_rate(&ds_gauge, &vl);
+  CHECK_NOT_NULL(rates);
+  sfree(rates);
+
+  cdtime_mock = start + TIME_T_TO_CDTIME_T(36);
+  CHECK_ZERO(uc_check_timeout());
+  EXPECT_EQ_PTR(NULL, uc_get_rate(&ds_gauge, &vl));
+
+  return 0;
+}
+
+DEF_TEST(threshold) {
+  value_list_t vl;
+  value_t value;
+  struct threshold_s *th = (struct threshold_s *)&value;
+  struct threshold_s *got = NULL;
+
+  CHECK_ZERO(uc_init());
+
+  fill_vl(&vl, &value, 1);
+  sstrncpy(vl.plugin, "threshold", sizeof(vl.plugin));
+
+  /* Unknown values can't hold a cached result. */
+  EXPECT_EQ_INT(ENOENT, uc_set_threshold(&vl, 1, th));
+  EXPECT_EQ_INT(ENOENT, uc_get_threshold(&vl, 1, &got));
+
+  CHECK_ZERO(uc_update(&ds_gauge, &vl));
+  EXPECT_EQ_INT(ENOENT, uc_get_threshold(&vl, 1, &got));
+
+  CHECK_ZERO(uc_set_threshold(&vl, 1, th));
+  CHECK_ZERO(uc_get_threshold(&vl, 1, &got));
+  EXPECT_EQ_PTR(th, got);
+
+  /* A new generation invalidates the cached result. */
+  EXPECT_EQ_INT(ENOENT, uc_get_threshold(&vl, 2, &got));
+
+  /* "No threshold" is a result, too. */
+  CHECK_ZERO(uc_set_threshold(&vl, 2, NULL));
+  got = th;
+  CHECK_ZERO(uc_get_threshold(&vl, 2, &got));
+  EXPECT_EQ_PTR(NULL, got);
+
+  return 0;
+}
+
+/* Entries saved to a file are loaded with their values and rates. */
+DEF_TEST(file) {
+  data_set_t const *ds = plugin_get_ds("MAGIC");
+  value_list_t vl;
+  value_t value;
+  char file[] = "/tmp/utils_cache_test.XXXXXX";
+
+  int fd = mkstemp(file);
+  CHECK_NOT_NULL(fd >= 0 ? file : NULL);
+  close(fd);
+
+  CHECK_ZERO(uc_init());
+
+  /* Without an interval, the entry expires on the next uc_check_timeout(). */
+  fill_vl(&vl, &value, 2);
+  sstrncpy(vl.plugin, "file", sizeof(vl.plugin));
+  sstrncpy(vl.type, "MAGIC", sizeof(vl.type));
+  vl.time = TIME_T_TO_CDTIME_T(10);
+  value.derive = 100;
+  CHECK_ZERO(uc_update(ds, &vl));
+  vl.time = TIME_T_TO_CDTIME_T(20);
+  value.derive = 200;
+  CHECK_ZERO(uc_update(ds, &vl));
+
+  CHECK_ZERO(uc_save_file(file));
+  CHECK_ZERO(uc_check_timeout());
+  EXPECT_EQ_PTR(NULL, uc_get_rate(ds, &vl));
+
+  CHECK_ZERO(uc_load_file(file));
+  gauge_t *rates = uc_get_rate(ds, &vl);
+  CHECK_NOT_NULL(rates);
+  EXPECT_EQ_DOUBLE(10.0, rates[0]);
+  sfree(rates);
+
+  /* Loading again skips the entries that are cached. */
+  CHECK_ZERO(uc_load_file(file));
+
+  /* The next rate is computed from the loaded value and time. */
+  vl.time = TIME_T_TO_CDTIME_T(30);
+  value.derive = 400;
+  CHECK_ZERO(uc_update(ds, &vl));
+  CHECK_NOT_NULL(rates = uc_get_rate(ds, &vl));
+  EXPECT_EQ_DOUBLE(20.0, rates[0]);
+  sfree(rates);
+
+  /* An update that is older than the loaded one is rejected. */
+  vl.time = TIME_T_TO_CDTIME_T(25);
+  EXPECT_EQ_INT(-1, uc_update(ds, &vl));
+
+  /* A truncated file is rejected. */
+  CHECK_ZERO(truncate(file, 512));
+  EXPECT_EQ_INT(EINVAL, uc_load_file(file));
+  CHECK_ZERO(truncate(file, 8));
+  EXPECT_EQ_INT(EINVAL, uc_load_file(file));
+
+  CHECK_ZERO(unlink(file));
+  EXPECT_EQ_INT(ENOENT, uc_load_file(file));
+
+  return 0;
+}
+
+int main(void) {
+  /* Rates are computed with the conversion plan of the registered type. */
+  plugin_register_data_set(&ds_gauge);
+
+  RUN_TEST(cache);
+  RUN_TEST(history);
+  RUN_TEST(rate);
+  RUN_TEST(update_changed);
+  RUN_TEST(timeout);
+  RUN_TEST(threshold);
+  RUN_TEST(file);
+
+  END_TEST;
+}
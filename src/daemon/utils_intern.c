@@ -0,0 +1,274 @@
+/**
+ * collectd - src/daemon/utils_intern.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "utils/common/common.h"
+#include "utils_intern.h"
+
+#define INTERN_SHARDS_NUM 64
+#define INTERN_BUCKETS_MIN 16
+#define INTERN_FIELDS_NUM 5
+
+struct interned_identifier_s {
+  interned_identifier_t *next; /* next identifier in the same bucket */
+  uint64_t hash;
+  unsigned int refs;
+  /* Set by identifier_intern_gc() if the identifier was not referenced. The
+   * identifier is freed if it is still unreferenced during the next run. */
+  bool idle;
+  /* Cached data set handle of the type, see identifier_ds_handle(). */
+  ds_handle_t ds_handle;
+  /* Offsets of host, plugin, plugin instance, type and type instance in
+   * `data'. */
+  uint16_t offsets[INTERN_FIELDS_NUM];
+  char data[];
+};
+
+typedef struct {
+  pthread_mutex_t lock;
+  interned_identifier_t **buckets;
+  size_t buckets_num; /* always a power of two */
+  size_t entries_num;
+} intern_shard_t;
+
+static intern_shard_t intern_shards[INTERN_SHARDS_NUM];
+static pthread_once_t intern_once = PTHREAD_ONCE_INIT;
+
+static void intern_init(void) {
+  for (size_t i = 0; i < INTERN_SHARDS_NUM; i++)
+    pthread_mutex_init(&intern_shards[i].lock, /* attr = */ NULL);
+} /* void intern_init */
+
+static intern_shard_t *intern_get_shard(uint64_t hash) {
+  return intern_shards + ((hash >> 32) % INTERN_SHARDS_NUM);
+} /* intern_shard_t *intern_get_shard */
+
+static void vl_fields(value_list_t const *vl,
+                      char const *fields[INTERN_FIELDS_NUM],
+                      size_t lengths[INTERN_FIELDS_NUM]) {
+  fields[0] = vl->host;
+  fields[1] = vl->plugin;
+  fields[2] = vl->plugin_instance;
+  fields[3] = vl->type;
+  fields[4] = vl->type_instance;
+
+  for (size_t i = 0; i < INTERN_FIELDS_NUM; i++)
+    lengths[i] = strnlen(fields[i], DATA_MAX_NAME_LEN - 1);
+} /* void vl_fields */
+
+static bool identifier_matches(interned_identifier_t const *id,
+                               char const *fields[INTERN_FIELDS_NUM],
+                               size_t lengths[INTERN_FIELDS_NUM]) {
+  for (size_t i = 0; i < INTERN_FIELDS_NUM; i++) {
+    char const *s = id->data + id->offsets[i];
+    if ((strncmp(s, fields[i], lengths[i]) != 0) || (s[lengths[i]] != 0))
+      return false;
+  }
+  return true;
+} /* bool identifier_matches */
+
+/* Must hold `shard->lock' when calling. */
+static int intern_resize(intern_shard_t *shard, size_t buckets_num) {
+  interned_identifier_t **buckets = calloc(buckets_num, sizeof(*buckets));
+  if (buckets == NULL)
+    return ENOMEM;
+
+  for (size_t i = 0; i < shard->buckets_num; i++) {
+    interned_identifier_t *id = shard->buckets[i];
+    while (id != NULL) {
+      interned_identifier_t *next = id->next;
+      size_t pos = id->hash & (buckets_num - 1);
+
+      id->next = buckets[pos];
+      buckets[pos] = id;
+      id = next;
+    }
+  }
+
+  sfree(shard->buckets);
+  shard->buckets = buckets;
+  shard->buckets_num = buckets_num;
+  return 0;
+} /* int intern_resize */
+
+interned_identifier_t *identifier_intern(value_list_t const *vl) {
+  char const *fields[INTERN_FIELDS_NUM];
+  size_t lengths[INTERN_FIELDS_NUM];
+
+  if (vl == NULL)
+    return NULL;
+
+  pthread_once(&intern_once, intern_init);
+
+  vl_fields(vl, fields, lengths);
+  uint64_t hash = HASH_VL(vl);
+  intern_shard_t *shard = intern_get_shard(hash);
+
+  pthread_mutex_lock(&shard->lock);
+
+  if (shard->buckets_num > 0) {
+    for (interned_identifier_t *id =
+             shard->buckets[hash & (shard->buckets_num - 1)];
+         id != NULL; id = id->next) {
+      if ((id->hash != hash) || !identifier_matches(id, fields, lengths))
+        continue;
+
+      __atomic_add_fetch(&id->refs, 1, __ATOMIC_RELAXED);
+      id->idle = false;
+      pthread_mutex_unlock(&shard->lock);
+      return id;
+    }
+  }
+
+  if ((shard->entries_num >= shard->buckets_num) &&
+      (intern_resize(shard, (shard->buckets_num > 0)
+                                ? 2 * shard->buckets_num
+                                : INTERN_BUCKETS_MIN) != 0)) {
+    pthread_mutex_unlock(&shard->lock);
+    ERROR("identifier_intern: intern_resize failed.");
+    return NULL;
+  }
+
+  size_t data_size = 0;
+  for (size_t i = 0; i < INTERN_FIELDS_NUM; i++)
+    data_size += lengths[i] + 1;
+
+  interned_identifier_t *id = calloc(1, sizeof(*id) + data_size);
+  if (id == NULL) {
+    pthread_mutex_unlock(&shard->lock);
+    ERROR("identifier_intern: calloc failed.");
+    return NULL;
+  }
+  id->hash = hash;
+  id->refs = 1;
+  id->ds_handle = DS_HANDLE_INVALID;
+
+  size_t offset = 0;
+  for (size_t i = 0; i < INTERN_FIELDS_NUM; i++) {
+    id->offsets[i] = (uint16_t)offset;
+    memcpy(id->data + offset, fields[i], lengths[i]);
+    offset += lengths[i] + 1;
+  }
+
+  size_t pos = hash & (shard->buckets_num - 1);
+  id->next = shard->buckets[pos];
+  shard->buckets[pos] = id;
+  shard->entries_num++;
+
+  pthread_mutex_unlock(&shard->lock);
+  return id;
+} /* interned_identifier_t *identifier_intern */
+
+interned_identifier_t *identifier_ref(interned_identifier_t *id) {
+  if (id == NULL)
+    return NULL;
+
+  /* The caller holds a reference, so the identifier cannot be freed
+   * concurrently. */
+  __atomic_add_fetch(&id->refs, 1, __ATOMIC_RELAXED);
+  return id;
+} /* interned_identifier_t *identifier_ref */
+
+void identifier_release(interned_identifier_t *id) {
+  if (id == NULL)
+    return;
+
+  __atomic_sub_fetch(&id->refs, 1, __ATOMIC_RELEASE);
+} /* void identifier_release */
+
+void identifier_to_vl(interned_identifier_t const *id, value_list_t *vl) {
+  if ((id == NULL) || (vl == NULL))
+    return;
+
+  sstrncpy(vl->host, id->data + id->offsets[0], sizeof(vl->host));
+  sstrncpy(vl->plugin, id->data + id->offsets[1], sizeof(vl->plugin));
+  sstrncpy(vl->plugin_instance, id->data + id->offsets[2],
+           sizeof(vl->plugin_instance));
+  sstrncpy(vl->type, id->data + id->offsets[3], sizeof(vl->type));
+  sstrncpy(vl->type_instance, id->data + id->offsets[4],
+           sizeof(vl->type_instance));
+} /* void identifier_to_vl */
+
+uint64_t identifier_hash(interned_identifier_t const *id) {
+  return (id != NULL) ? id->hash : 0;
+} /* uint64_t identifier_hash */
+
+ds_handle_t identifier_ds_handle(interned_identifier_t const *id) {
+  if (id == NULL)
+    return DS_HANDLE_INVALID;
+  return __atomic_load_n(&id->ds_handle, __ATOMIC_RELAXED);
+} /* ds_handle_t identifier_ds_handle */
+
+void identifier_set_ds_handle(interned_identifier_t *id, ds_handle_t handle) {
+  if (id == NULL)
+    return;
+  __atomic_store_n(&id->ds_handle, handle, __ATOMIC_RELAXED);
+} /* void identifier_set_ds_handle */
+
+void identifier_intern_gc(void) {
+  pthread_once(&intern_once, intern_init);
+
+  for (size_t i = 0; i < INTERN_SHARDS_NUM; i++) {
+    intern_shard_t *shard = intern_shards + i;
+
+    pthread_mutex_lock(&shard->lock);
+    for (size_t j = 0; j < shard->buckets_num; j++) {
+      interned_identifier_t **prev = shard->buckets + j;
+
+      while (*prev != NULL) {
+        interned_identifier_t *id = *prev;
+
+        /* New references are only taken under the shard's lock or by
+         * somebody already holding one, so zero references means the
+         * identifier is unused. */
+        if (__atomic_load_n(&id->refs, __ATOMIC_ACQUIRE) != 0) {
+          id->idle = false;
+        } else if (!id->idle) {
+          id->idle = true;
+        } else {
+          *prev = id->next;
+          shard->entries_num--;
+          sfree(id);
+          continue;
+        }
+        prev = &id->next;
+      }
+    }
+    pthread_mutex_unlock(&shard->lock);
+  }
+} /* void identifier_intern_gc */
+
+size_t identifier_intern_size(void) {
+  size_t num = 0;
+
+  pthread_once(&intern_once, intern_init);
+
+  for (size_t i = 0; i < INTERN_SHARDS_NUM; i++) {
+    pthread_mutex_lock(&intern_shards[i].lock);
+    num += intern_shards[i].entries_num;
+    pthread_mutex_unlock(&intern_shards[i].lock);
+  }
+
+  return num;
+} /* size_t identifier_intern_size */
@@ -0,0 +1,71 @@
+/**
+ * collectd - src/daemon/utils_intern.h
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_INTERN_H
+#define UTILS_INTERN_H 1
+
+#include "plugin.h"
+
+/* Interned identifiers: a global table that stores every distinct five-part
+ * identifier (host, plugin, plugin instance, type, type instance) once and
+ * hands out counted references to it. Code that keeps many copies of value
+ * lists around, for example the write queues, can hold a pointer to an
+ * interned identifier instead of the 640 bytes of name fields in each
+ * value_list_t. */
+struct interned_identifier_s;
+typedef struct interned_identifier_s interned_identifier_t;
+
+/* Returns a reference to the interned identifier of `vl', adding it to the
+ * table if necessary. Returns NULL if memory is exhausted. The reference must
+ * be released with identifier_release(). */
+interned_identifier_t *identifier_intern(value_list_t const *vl);
+
+/* Takes another reference to `id'. Cheaper than identifier_intern(), because
+ * it doesn't need to look the identifier up. */
+interned_identifier_t *identifier_ref(interned_identifier_t *id);
+
+/* Releases a reference. Identifiers that are no longer referenced stay in the
+ * table until identifier_intern_gc() cleans them up, so metrics that come and
+ * go every interval don't cause an allocation each time. */
+void identifier_release(interned_identifier_t *id);
+
+/* Copies the identifier's name fields into `vl'. */
+void identifier_to_vl(interned_identifier_t const *id, value_list_t *vl);
+
+/* Returns the hash of the identifier, see hash_identifier(). */
+uint64_t identifier_hash(interned_identifier_t const *id);
+
+/* Returns the data set handle stored with identifier_set_ds_handle(), or
+ * DS_HANDLE_INVALID if none has been stored. Lets the daemon resolve the type
+ * of a series once instead of for every value. */
+ds_handle_t identifier_ds_handle(interned_identifier_t const *id);
+void identifier_set_ds_handle(interned_identifier_t *id, ds_handle_t handle);
+
+/* Frees identifiers that have not been referenced since the previous call.
+ * Called once per interval by the daemon. */
+void identifier_intern_gc(void);
+
+/* Returns the number of identifiers in the table. */
+size_t identifier_intern_size(void);
+
+#endif /* UTILS_INTERN_H */
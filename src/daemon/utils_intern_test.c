@@ -0,0 +1,131 @@
+/**
+ * collectd - src/daemon/utils_intern_test.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/common/common.h"
+#include "utils_intern.h"
+
+static value_list_t make_vl(char const *host, char const *type_instance) {
+  value_list_t vl = VALUE_LIST_INIT;
+
+  sstrncpy(vl.host, host, sizeof(vl.host));
+  sstrncpy(vl.plugin, "test", sizeof(vl.plugin));
+  sstrncpy(vl.plugin_instance, "0", sizeof(vl.plugin_instance));
+  sstrncpy(vl.type, "gauge", sizeof(vl.type));
+  sstrncpy(vl.type_instance, type_instance, sizeof(vl.type_instance));
+
+  return vl;
+}
+
+DEF_TEST(intern) {
+  value_list_t vl0 = make_vl("example.com", "foo");
+  value_list_t vl1 = make_vl("example.com", "bar");
+  /* The fields must be compared one by one, not concatenated. */
+  value_list_t vl2 = make_vl("example.co", "foo");
+  sstrncpy(vl2.plugin, "mtest", sizeof(vl2.plugin));
+
+  interned_identifier_t *id0;
+  interned_identifier_t *id1;
+  interned_identifier_t *id2;
+  CHECK_NOT_NULL(id0 = identifier_intern(&vl0));
+  CHECK_NOT_NULL(id1 = identifier_intern(&vl1));
+  CHECK_NOT_NULL(id2 = identifier_intern(&vl2));
+  OK(id0 != id1);
+  OK(id0 != id2);
+  EXPECT_EQ_UINT64(3, identifier_intern_size());
+  EXPECT_EQ_UINT64(HASH_VL(&vl0), identifier_hash(id0));
+
+  /* Interning the same identifier again returns the same object. */
+  EXPECT_EQ_PTR(id0, identifier_intern(&vl0));
+  EXPECT_EQ_PTR(id0, identifier_ref(id0));
+  EXPECT_EQ_UINT64(3, identifier_intern_size());
+
+  value_list_t vl = VALUE_LIST_INIT;
+  identifier_to_vl(id2, &vl);
+  EXPECT_EQ_STR("example.co", vl.host);
+  EXPECT_EQ_STR("mtest", vl.plugin);
+  EXPECT_EQ_STR("0", vl.plugin_instance);
+  EXPECT_EQ_STR("gauge", vl.type);
+  EXPECT_EQ_STR("foo", vl.type_instance);
+
+  /* Unreferenced identifiers survive one garbage collection run. */
+  identifier_release(id1);
+  identifier_release(id2);
+  identifier_intern_gc();
+  EXPECT_EQ_UINT64(3, identifier_intern_size());
+
+  /* Referencing an identifier again makes it survive the next run, too. */
+  EXPECT_EQ_PTR(id1, identifier_intern(&vl1));
+  identifier_release(id1);
+  identifier_intern_gc();
+  EXPECT_EQ_UINT64(2, identifier_intern_size());
+  identifier_intern_gc();
+  EXPECT_EQ_UINT64(1, identifier_intern_size());
+
+  /* `id0' is still referenced three times. */
+  for (int i = 0; i < 3; i++) {
+    identifier_intern_gc();
+    EXPECT_EQ_UINT64(1, identifier_intern_size());
+    identifier_release(id0);
+  }
+  identifier_intern_gc();
+  identifier_intern_gc();
+  EXPECT_EQ_UINT64(0, identifier_intern_size());
+
+  return 0;
+}
+
+DEF_TEST(many) {
+  char buffer[DATA_MAX_NAME_LEN];
+  interned_identifier_t *ids[1000];
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(ids); i++) {
+    snprintf(buffer, sizeof(buffer), "%" PRIsz, i);
+    value_list_t vl = make_vl("example.com", buffer);
+    CHECK_NOT_NULL(ids[i] = identifier_intern(&vl));
+  }
+  EXPECT_EQ_UINT64(STATIC_ARRAY_SIZE(ids), identifier_intern_size());
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(ids); i++) {
+    snprintf(buffer, sizeof(buffer), "%" PRIsz, i);
+    value_list_t vl = make_vl("example.com", buffer);
+    EXPECT_EQ_PTR(ids[i], identifier_intern(&vl));
+    identifier_release(ids[i]);
+    identifier_release(ids[i]);
+  }
+
+  identifier_intern_gc();
+  identifier_intern_gc();
+  EXPECT_EQ_UINT64(0, identifier_intern_size());
+
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(intern);
+  RUN_TEST(many);
+
+  END_TEST;
+}
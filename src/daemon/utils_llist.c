@@ -27,6 +27,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "utils/memstats/memstats.h"
 #include "utils_llist.h"
 
 /*
@@ -36,6 +37,9 @@ struct llist_s {
   llentry_t *head;
   llentry_t *tail;
   int size;
+  /* Plugin that created the list. The list and the entries in it are
+   * accounted to it. */
+  memstats_owner_t *owner;
 };
 
 /*
@@ -48,6 +52,8 @@ llist_t *llist_create(void) {
   if (ret == NULL)
     return NULL;
 
+  ret->owner = memstats_owner_current();
+  memstats_add(ret->owner, (int64_t)sizeof(*ret), 1);
   return ret;
 }
 
@@ -63,6 +69,8 @@ void llist_destroy(llist_t *l) {
     llentry_destroy(e_this);
   }
 
+  memstats_add(l->owner, -(int64_t)(sizeof(*l) + l->size * sizeof(llentry_t)),
+               -(1 + l->size));
   free(l);
 }
 
@@ -92,6 +100,7 @@ void llist_append(llist_t *l, llentry_t *e) {
   l->tail = e;
 
   ++(l->size);
+  memstats_add(l->owner, (int64_t)sizeof(*e), 1);
 }
 
 void llist_prepend(llist_t *l, llentry_t *e) {
@@ -102,6 +111,7 @@ void llist_prepend(llist_t *l, llentry_t *e) {
     l->tail = e;
 
   ++(l->size);
+  memstats_add(l->owner, (int64_t)sizeof(*e), 1);
 }
 
 void llist_remove(llist_t *l, llentry_t *e) {
@@ -122,6 +132,7 @@ void llist_remove(llist_t *l, llentry_t *e) {
     l->tail = prev;
 
   --(l->size);
+  memstats_add(l->owner, -(int64_t)sizeof(*e), -1);
 }
 
 int llist_size(llist_t *l) { return l ? l->size : 0; }
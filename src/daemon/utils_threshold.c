@@ -28,6 +28,7 @@
 
 #include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
+#include "utils_cache.h"
 #include "utils_threshold.h"
 
 #include <pthread.h>
@@ -37,6 +38,7 @@
  * {{{ */
 c_avl_tree_t *threshold_tree = NULL;
 pthread_mutex_t threshold_lock = PTHREAD_MUTEX_INITIALIZER;
+uint64_t threshold_generation = 1;
 /* }}} */
 
 /*
@@ -111,6 +113,34 @@ threshold_t *threshold_search(const value_list_t *vl) { /* {{{ */
   return NULL;
 } /* }}} threshold_t *threshold_search */
 
+/*
+ * threshold_t *threshold_search_cached
+ *
+ * Like "threshold_search", but caches the result (including "no threshold") in
+ * the value's cache entry, so that only the first lookup of each value after
+ * the thresholds changed walks the tree. Must be called without holding
+ * "threshold_lock".
+ */
+threshold_t *threshold_search_cached(const value_list_t *vl) { /* {{{ */
+  threshold_t *th = NULL;
+
+  uint64_t generation =
+      __atomic_load_n(&threshold_generation, __ATOMIC_ACQUIRE);
+  if (uc_get_threshold(vl, generation, &th) == 0)
+    return th;
+
+  pthread_mutex_lock(&threshold_lock);
+  th = threshold_search(vl);
+  generation = threshold_generation;
+  pthread_mutex_unlock(&threshold_lock);
+
+  /* Fails if the value is not in the cache, e.g. when called for an
+   * identifier that has never been dispatched. */
+  uc_set_threshold(vl, generation, th);
+
+  return th;
+} /* }}} threshold_t *threshold_search_cached */
+
 int ut_search_threshold(const value_list_t *vl, /* {{{ */
                         threshold_t *ret_threshold) {
   threshold_t *t;
@@ -118,9 +148,9 @@ int ut_search_threshold(const value_list_t *vl, /* {{{ */
   if (vl == NULL)
     return EINVAL;
 
-  /* Is this lock really necessary? */
+  t = threshold_search_cached(vl);
+
   pthread_mutex_lock(&threshold_lock);
-  t = threshold_search(vl);
   if (t == NULL) {
     pthread_mutex_unlock(&threshold_lock);
     return ENOENT;
@@ -51,12 +51,17 @@ typedef struct threshold_s {
 
 extern c_avl_tree_t *threshold_tree;
 extern pthread_mutex_t threshold_lock;
+/* Must be incremented, with threshold_lock held, whenever threshold_tree or
+ * one of its lists of thresholds is modified. Invalidates the results cached
+ * by threshold_search_cached(). */
+extern uint64_t threshold_generation;
 
 threshold_t *threshold_get(const char *hostname, const char *plugin,
                            const char *plugin_instance, const char *type,
                            const char *type_instance);
 
 threshold_t *threshold_search(const value_list_t *vl);
+threshold_t *threshold_search_cached(const value_list_t *vl);
 
 int ut_search_threshold(const value_list_t *vl, threshold_t *ret_threshold);
 
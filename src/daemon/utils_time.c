@@ -71,6 +71,36 @@ cdtime_t cdtime(void) /* {{{ */
 #endif
 #endif
 
+#if !defined(MOCK_TIME) && HAVE_CLOCK_GETTIME && defined(CLOCK_REALTIME_COARSE)
+cdtime_t cdtime_coarse(void) /* {{{ */
+{
+  struct timespec ts = {0, 0};
+
+  if (clock_gettime(CLOCK_REALTIME_COARSE, &ts) != 0)
+    return cdtime();
+
+  return TIMESPEC_TO_CDTIME_T(&ts);
+} /* }}} cdtime_t cdtime_coarse */
+#else
+cdtime_t cdtime_coarse(void) { return cdtime(); }
+#endif
+
+static __thread cdtime_t cdtime_thread_cache;
+
+cdtime_t cdtime_cached(void) /* {{{ */
+{
+  if (cdtime_thread_cache != 0)
+    return cdtime_thread_cache;
+  return cdtime();
+} /* }}} cdtime_t cdtime_cached */
+
+cdtime_t cdtime_cache_set(cdtime_t t) /* {{{ */
+{
+  cdtime_t old = cdtime_thread_cache;
+  cdtime_thread_cache = t;
+  return old;
+} /* }}} cdtime_t cdtime_cache_set */
+
 /**********************************************************************
  Time retrieval functions
 ***********************************************************************/
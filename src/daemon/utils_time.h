@@ -110,6 +110,24 @@ extern cdtime_t cdtime_mock;
 
 cdtime_t cdtime(void);
 
+/* cdtime_coarse returns the current time like cdtime(), but from a clock
+ * that is cheaper to read and only updated every few milliseconds
+ * (CLOCK_REALTIME_COARSE on Linux). Where that clock is not available, it is
+ * the same as cdtime(). */
+cdtime_t cdtime_coarse(void);
+
+/* cdtime_cached returns the time stored with cdtime_cache_set() by the
+ * calling thread, or the current time if there is none. The daemon sets it
+ * for the duration of every read callback and while dispatching a batch of
+ * value lists, so plugins that are happy with one time stamp per read can
+ * use this instead of cdtime(). */
+cdtime_t cdtime_cached(void);
+
+/* cdtime_cache_set sets the time returned by cdtime_cached() in the calling
+ * thread; zero unsets it. Returns the previous value, so nested users can
+ * restore it when they are done. */
+cdtime_t cdtime_cache_set(cdtime_t t);
+
 #define RFC3339_SIZE 26     /* 2006-01-02T15:04:05+00:00 */
 #define RFC3339NANO_SIZE 36 /* 2006-01-02T15:04:05.999999999+00:00 */
 
@@ -161,9 +161,31 @@ DEF_TEST(ns_to_cdtime) {
   return 0;
 }
 
+DEF_TEST(cache) {
+  cdtime_t t = TIME_T_TO_CDTIME_T(1500000000);
+
+  /* Without a cached time, cdtime_cached() is cdtime(). */
+  EXPECT_EQ_UINT64(cdtime(), cdtime_cached());
+
+  EXPECT_EQ_UINT64(0, cdtime_cache_set(t));
+  EXPECT_EQ_UINT64(t, cdtime_cached());
+
+  /* nested use */
+  cdtime_t old = cdtime_cache_set(cdtime_cached());
+  EXPECT_EQ_UINT64(t, old);
+  EXPECT_EQ_UINT64(t, cdtime_cached());
+  cdtime_cache_set(old);
+
+  EXPECT_EQ_UINT64(t, cdtime_cache_set(0));
+  EXPECT_EQ_UINT64(cdtime(), cdtime_cached());
+
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(conversion);
   RUN_TEST(ns_to_cdtime);
+  RUN_TEST(cache);
 
   END_TEST;
 }
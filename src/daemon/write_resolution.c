@@ -0,0 +1,364 @@
+/**
+ * collectd - src/daemon/write_resolution.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "utils/avltree/avltree.h"
+#include "utils/common/common.h"
+#include "utils/metadata/meta_data.h"
+#include "write_resolution.h"
+
+typedef struct {
+  gauge_t sum;
+  gauge_t min;
+  gauge_t max;
+  size_t num; /* number of gauges in `sum', NaNs are skipped */
+  absolute_t absolute;
+  value_t last;
+} wr_source_t;
+
+typedef struct {
+  data_set_t const *ds;
+  /* Identifier and meta data of the last value list. The values are not
+   * used. */
+  value_list_t vl;
+  cdtime_t end;          /* end of the current window, zero if it is empty */
+  cdtime_t consolidated; /* end of the last consolidated window */
+  cdtime_t last_time;
+  cdtime_t last_interval;
+  size_t values_len;
+  wr_source_t sources[];
+} wr_series_t;
+
+struct write_resolution_s {
+  cdtime_t resolution;
+  write_resolution_function_t func;
+  pthread_mutex_t lock;
+  c_avl_tree_t *series; /* identifier -> wr_series_t */
+};
+
+static cdtime_t window_end(write_resolution_t const *wr, cdtime_t t) {
+  cdtime_t rem = t % wr->resolution;
+  return (rem == 0) ? t : t - rem + wr->resolution;
+}
+
+/* Time after which the window of `s' is consolidated even though no value of
+ * the next window has arrived. The extra resolution leaves room for values
+ * still waiting in the write queue. */
+static cdtime_t series_overdue(write_resolution_t const *wr,
+                               wr_series_t const *s) {
+  cdtime_t wait = wr->resolution;
+  if (s->last_interval > wait)
+    wait = s->last_interval;
+  return s->end + wait;
+}
+
+static void series_destroy(wr_series_t *s) {
+  if (s == NULL)
+    return;
+  meta_data_destroy(s->vl.meta);
+  free(s);
+}
+
+static wr_series_t *series_create(data_set_t const *ds,
+                                  value_list_t const *vl) {
+  wr_series_t *s =
+      calloc(1, sizeof(*s) + vl->values_len * sizeof(s->sources[0]));
+  if (s == NULL)
+    return NULL;
+
+  s->ds = ds;
+  s->vl = *vl;
+  s->vl.values = NULL;
+  s->vl.values_len = 0;
+  s->vl.rates = NULL;
+  s->vl.meta = NULL;
+  s->values_len = vl->values_len;
+  return s;
+}
+
+static void series_add(wr_series_t *s, value_list_t const *vl) {
+  for (size_t i = 0; i < s->values_len; i++) {
+    wr_source_t *src = s->sources + i;
+    value_t v = vl->values[i];
+
+    if (s->ds->ds[i].type == DS_TYPE_GAUGE) {
+      if (!isnan(v.gauge)) {
+        if ((src->num == 0) || (v.gauge < src->min))
+          src->min = v.gauge;
+        if ((src->num == 0) || (v.gauge > src->max))
+          src->max = v.gauge;
+        src->sum += v.gauge;
+        src->num++;
+      }
+    } else if (s->ds->ds[i].type == DS_TYPE_ABSOLUTE) {
+      src->absolute += v.absolute;
+    }
+    src->last = v;
+  }
+
+  meta_data_destroy(s->vl.meta);
+  s->vl.meta = meta_data_clone(vl->meta);
+  s->last_time = vl->time;
+  s->last_interval = vl->interval;
+}
+
+static gauge_t source_gauge(wr_source_t const *src,
+                            write_resolution_function_t func) {
+  if (func == WRITE_RESOLUTION_LAST)
+    return src->last.gauge;
+  if (src->num == 0)
+    return NAN;
+
+  switch (func) {
+  case WRITE_RESOLUTION_MINIMUM:
+    return src->min;
+  case WRITE_RESOLUTION_MAXIMUM:
+    return src->max;
+  default:
+    return src->sum / (gauge_t)src->num;
+  }
+}
+
+/* Moves the current window of `s' into `ret' and starts an empty one. */
+static int series_consolidate(write_resolution_t const *wr, wr_series_t *s,
+                              write_resolution_value_t *ret) {
+  value_t *values = calloc(s->values_len, sizeof(*values));
+  if (values == NULL)
+    return ENOMEM;
+
+  for (size_t i = 0; i < s->values_len; i++) {
+    wr_source_t const *src = s->sources + i;
+    switch (s->ds->ds[i].type) {
+    case DS_TYPE_GAUGE:
+      values[i].gauge = source_gauge(src, wr->func);
+      break;
+    case DS_TYPE_ABSOLUTE:
+      values[i].absolute = src->absolute;
+      break;
+    default:
+      values[i] = src->last;
+    }
+  }
+
+  ret->ds = s->ds;
+  ret->vl = s->vl;
+  ret->vl.values = values;
+  ret->vl.values_len = s->values_len;
+  ret->vl.time = s->end;
+  ret->vl.interval = wr->resolution;
+  /* The meta data is handed over; the next value list brings its own. */
+  s->vl.meta = NULL;
+
+  s->consolidated = s->end;
+  s->end = 0;
+  memset(s->sources, 0, s->values_len * sizeof(s->sources[0]));
+  return 0;
+}
+
+write_resolution_t *write_resolution_create(cdtime_t resolution,
+                                            write_resolution_function_t func) {
+  if (resolution == 0)
+    return NULL;
+
+  write_resolution_t *wr = calloc(1, sizeof(*wr));
+  if (wr == NULL)
+    return NULL;
+
+  wr->series = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (wr->series == NULL) {
+    free(wr);
+    return NULL;
+  }
+  wr->resolution = resolution;
+  wr->func = func;
+  pthread_mutex_init(&wr->lock, NULL);
+  return wr;
+}
+
+void write_resolution_destroy(write_resolution_t *wr) {
+  if (wr == NULL)
+    return;
+
+  void *key = NULL;
+  void *value = NULL;
+  while (c_avl_pick(wr->series, &key, &value) == 0) {
+    free(key);
+    series_destroy(value);
+  }
+  c_avl_destroy(wr->series);
+  pthread_mutex_destroy(&wr->lock);
+  free(wr);
+}
+
+int write_resolution_add(write_resolution_t *wr, data_set_t const *ds,
+                         value_list_t const *vl,
+                         write_resolution_value_t *ret) {
+  if (ret != NULL)
+    ret->ds = NULL;
+  if ((wr == NULL) || (ds == NULL) || (vl == NULL) || (ret == NULL) ||
+      (vl->values_len != ds->ds_num) || (vl->time == 0))
+    return EINVAL;
+
+  char name[6 * DATA_MAX_NAME_LEN];
+  if (FORMAT_VL(name, sizeof(name), vl) != 0)
+    return EINVAL;
+
+  cdtime_t end = window_end(wr, vl->time);
+
+  pthread_mutex_lock(&wr->lock);
+
+  wr_series_t *s = NULL;
+  if (c_avl_get(wr->series, name, (void *)&s) != 0) {
+    char *key = strdup(name);
+    s = series_create(ds, vl);
+    if ((key == NULL) || (s == NULL) ||
+        (c_avl_insert(wr->series, key, s) != 0)) {
+      pthread_mutex_unlock(&wr->lock);
+      free(key);
+      series_destroy(s);
+      return ENOMEM;
+    }
+  }
+
+  if ((s->ds != ds) || (s->values_len != vl->values_len)) {
+    pthread_mutex_unlock(&wr->lock);
+    return EINVAL;
+  }
+
+  /* Late value of a window that has been written already. */
+  if (end <= s->consolidated) {
+    pthread_mutex_unlock(&wr->lock);
+    return 0;
+  }
+
+  if ((s->end != 0) && (end > s->end)) {
+    int status = series_consolidate(wr, s, ret);
+    if (status != 0) {
+      pthread_mutex_unlock(&wr->lock);
+      return status;
+    }
+  }
+
+  /* Values of an earlier, not yet consolidated window are counted towards the
+   * current one. */
+  if (s->end == 0)
+    s->end = end;
+  series_add(s, vl);
+
+  /* The next value belongs to the next window: no need to wait for it. */
+  int status = 0;
+  if ((ret->ds == NULL) && (vl->interval > 0) &&
+      (vl->time + vl->interval > s->end))
+    status = series_consolidate(wr, s, ret);
+
+  pthread_mutex_unlock(&wr->lock);
+  return status;
+}
+
+int write_resolution_flush(write_resolution_t *wr, cdtime_t now,
+                           write_resolution_value_t **ret, size_t *ret_num) {
+  if ((wr == NULL) || (ret == NULL) || (ret_num == NULL))
+    return EINVAL;
+
+  write_resolution_value_t *values = NULL;
+  size_t values_num = 0;
+  size_t values_size = 0;
+  char **idle = NULL;
+  size_t idle_num = 0;
+  int status = 0;
+
+  pthread_mutex_lock(&wr->lock);
+
+  c_avl_iterator_t *iter = c_avl_get_iterator(wr->series);
+  char *key;
+  wr_series_t *s;
+  while (c_avl_iterator_next(iter, (void *)&key, (void *)&s) == 0) {
+    if ((s->end == 0) && (now != 0)) {
+      cdtime_t wait = 2 * wr->resolution;
+      if (s->last_interval > wr->resolution)
+        wait = 2 * s->last_interval;
+      if (now < s->last_time + wait)
+        continue;
+
+      char **tmp = realloc(idle, (idle_num + 1) * sizeof(*idle));
+      if (tmp == NULL) {
+        status = ENOMEM;
+        break;
+      }
+      idle = tmp;
+      idle[idle_num++] = key;
+      continue;
+    }
+
+    if ((s->end == 0) || ((now != 0) && (now < series_overdue(wr, s))))
+      continue;
+
+    if (values_num == values_size) {
+      size_t size = (values_size == 0) ? 16 : 2 * values_size;
+      write_resolution_value_t *tmp = realloc(values, size * sizeof(*values));
+      if (tmp == NULL) {
+        status = ENOMEM;
+        break;
+      }
+      values = tmp;
+      values_size = size;
+    }
+
+    status = series_consolidate(wr, s, values + values_num);
+    if (status != 0)
+      break;
+    values_num++;
+  }
+  c_avl_iterator_destroy(iter);
+
+  for (size_t i = 0; i < idle_num; i++) {
+    void *rkey = NULL;
+    void *rvalue = NULL;
+    if (c_avl_remove(wr->series, idle[i], &rkey, &rvalue) == 0) {
+      free(rkey);
+      series_destroy(rvalue);
+    }
+  }
+
+  pthread_mutex_unlock(&wr->lock);
+  free(idle);
+
+  *ret = values;
+  *ret_num = values_num;
+  return status;
+}
+
+void write_resolution_value_free(write_resolution_value_t *v) {
+  if (v == NULL)
+    return;
+  sfree(v->vl.values);
+  meta_data_destroy(v->vl.meta);
+  v->vl.meta = NULL;
+}
+
+void write_resolution_values_free(write_resolution_value_t *v, size_t num) {
+  for (size_t i = 0; i < num; i++)
+    write_resolution_value_free(v + i);
+  free(v);
+}
@@ -0,0 +1,115 @@
+/**
+ * collectd - src/daemon/write_resolution.h
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef WRITE_RESOLUTION_H
+#define WRITE_RESOLUTION_H 1
+
+#include "plugin.h"
+
+/*
+ * Consolidation of the values handed to a write callback to one value per
+ * series and window of "Resolution" length (see the <LoadPlugin> block).
+ * A window ends at a multiple of the resolution and includes its end, i.e.
+ * a value at time `t' belongs to the window ending at `t' rounded up. The
+ * consolidated value list has the window's end as time and the resolution as
+ * interval. Gauges are consolidated with the configured function, absolute
+ * values are summed and counters and derives keep their last value. Meta data
+ * is taken from the last value list of the window.
+ */
+typedef enum {
+  WRITE_RESOLUTION_AVERAGE = 0,
+  WRITE_RESOLUTION_MINIMUM,
+  WRITE_RESOLUTION_MAXIMUM,
+  WRITE_RESOLUTION_LAST,
+} write_resolution_function_t;
+
+struct write_resolution_s;
+typedef struct write_resolution_s write_resolution_t;
+
+/* A consolidated value list. Free with write_resolution_value_free(). */
+typedef struct {
+  data_set_t const *ds;
+  value_list_t vl;
+} write_resolution_value_t;
+
+/* Returns NULL if `resolution' is zero or on allocation failure. */
+write_resolution_t *write_resolution_create(cdtime_t resolution,
+                                            write_resolution_function_t func);
+void write_resolution_destroy(write_resolution_t *wr);
+
+/*
+ * NAME
+ *   write_resolution_add
+ *
+ * DESCRIPTION
+ *   Adds `vl' to the window of its series. If `vl' completes the window,
+ *   because the next value of the series is due after the window's end, or
+ *   starts a new one, the window is consolidated into `ret'. Otherwise
+ *   `ret->ds' is set to NULL. Values of windows which have already been
+ *   consolidated are dropped. May be called from several threads at once.
+ *
+ * RETURN VALUE
+ *   Zero upon success, an error number otherwise.
+ */
+int write_resolution_add(write_resolution_t *wr, data_set_t const *ds,
+                         value_list_t const *vl, write_resolution_value_t *ret);
+
+/*
+ * NAME
+ *   write_resolution_flush
+ *
+ * DESCRIPTION
+ *   Consolidates the windows whose next value is overdue at `now', or all
+ *   windows if `now' is zero, and forgets series that have been idle for two
+ *   windows. The consolidated value lists are returned in a newly allocated
+ *   array, to be freed with write_resolution_values_free().
+ *
+ * RETURN VALUE
+ *   Zero upon success, ENOMEM on allocation failure.
+ */
+int write_resolution_flush(write_resolution_t *wr, cdtime_t now,
+                           write_resolution_value_t **ret, size_t *ret_num);
+
+void write_resolution_value_free(write_resolution_value_t *v);
+void write_resolution_values_free(write_resolution_value_t *v, size_t num);
+
+/* Parses "Average", "Minimum", "Maximum" or "Last". Returns EINVAL if `name'
+ * is none of these. Inline, so that the configuration code can use it without
+ * linking the consolidation code. */
+static inline int
+write_resolution_function_parse(char const *name,
+                                write_resolution_function_t *ret) {
+  if (strcasecmp("Average", name) == 0)
+    *ret = WRITE_RESOLUTION_AVERAGE;
+  else if (strcasecmp("Minimum", name) == 0)
+    *ret = WRITE_RESOLUTION_MINIMUM;
+  else if (strcasecmp("Maximum", name) == 0)
+    *ret = WRITE_RESOLUTION_MAXIMUM;
+  else if (strcasecmp("Last", name) == 0)
+    *ret = WRITE_RESOLUTION_LAST;
+  else
+    return EINVAL;
+  return 0;
+}
+
+#endif /* WRITE_RESOLUTION_H */
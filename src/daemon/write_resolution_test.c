@@ -0,0 +1,229 @@
+/**
+ * collectd - src/daemon/write_resolution_test.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/common/common.h"
+#include "utils/metadata/meta_data.h"
+#include "write_resolution.h"
+
+static data_source_t gauge_dsrc = {"value", DS_TYPE_GAUGE, NAN, NAN};
+static data_set_t gauge_ds = {"gauge", 1, &gauge_dsrc};
+
+static data_source_t mixed_dsrc[] = {
+    {"derive", DS_TYPE_DERIVE, 0, NAN},
+    {"absolute", DS_TYPE_ABSOLUTE, 0, NAN},
+};
+static data_set_t mixed_ds = {"mixed", 2, mixed_dsrc};
+
+/* Adds a gauge at `t' seconds with an interval of one second. */
+static int add_gauge(write_resolution_t *wr, char const *instance, double t,
+                     gauge_t g, write_resolution_value_t *ret) {
+  value_list_t vl = {
+      .values = &(value_t){.gauge = g},
+      .values_len = 1,
+      .time = DOUBLE_TO_CDTIME_T(t),
+      .interval = TIME_T_TO_CDTIME_T(1),
+  };
+  sstrncpy(vl.host, "example.com", sizeof(vl.host));
+  sstrncpy(vl.plugin, "test", sizeof(vl.plugin));
+  sstrncpy(vl.type, "gauge", sizeof(vl.type));
+  sstrncpy(vl.type_instance, instance, sizeof(vl.type_instance));
+  return write_resolution_add(wr, &gauge_ds, &vl, ret);
+}
+
+DEF_TEST(functions) {
+  struct {
+    write_resolution_function_t func;
+    gauge_t want;
+  } cases[] = {
+      {WRITE_RESOLUTION_AVERAGE, 4.0},
+      {WRITE_RESOLUTION_MINIMUM, 1.0},
+      {WRITE_RESOLUTION_MAXIMUM, 9.0},
+      {WRITE_RESOLUTION_LAST, 4.0},
+  };
+  gauge_t values[] = {1.0, NAN, 9.0, 3.0, 4.0, 2.0, 5.0, 4.0, 4.0, 4.0};
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    write_resolution_t *wr =
+        write_resolution_create(TIME_T_TO_CDTIME_T(10), cases[i].func);
+    CHECK_NOT_NULL(wr);
+
+    write_resolution_value_t v;
+    for (size_t j = 0; j < STATIC_ARRAY_SIZE(values) - 1; j++) {
+      CHECK_ZERO(add_gauge(wr, "a", 1.0 + (double)j, values[j], &v));
+      EXPECT_EQ_PTR(NULL, (void *)v.ds);
+    }
+
+    /* The value at 10s completes the window (0s, 10s]. */
+    CHECK_ZERO(add_gauge(wr, "a", 10.0, values[9], &v));
+    EXPECT_EQ_PTR(&gauge_ds, (void *)v.ds);
+    EXPECT_EQ_UINT64(TIME_T_TO_CDTIME_T(10), v.vl.time);
+    EXPECT_EQ_UINT64(TIME_T_TO_CDTIME_T(10), v.vl.interval);
+    EXPECT_EQ_UINT64(1, v.vl.values_len);
+    EXPECT_EQ_STR("a", v.vl.type_instance);
+    EXPECT_EQ_DOUBLE(cases[i].want, v.vl.values[0].gauge);
+    write_resolution_value_free(&v);
+
+    write_resolution_destroy(wr);
+  }
+  return 0;
+}
+
+DEF_TEST(counters) {
+  write_resolution_t *wr = write_resolution_create(TIME_T_TO_CDTIME_T(60),
+                                                   WRITE_RESOLUTION_AVERAGE);
+  CHECK_NOT_NULL(wr);
+
+  value_t values[2];
+  value_list_t vl = {
+      .values = values,
+      .values_len = 2,
+      .interval = TIME_T_TO_CDTIME_T(20),
+  };
+  sstrncpy(vl.host, "example.com", sizeof(vl.host));
+  sstrncpy(vl.plugin, "test", sizeof(vl.plugin));
+  sstrncpy(vl.type, "mixed", sizeof(vl.type));
+
+  write_resolution_value_t v;
+  for (int i = 1; i <= 3; i++) {
+    values[0].derive = 100 * i;
+    values[1].absolute = (absolute_t)i;
+    vl.time = TIME_T_TO_CDTIME_T(20 * i);
+    CHECK_NOT_NULL(vl.meta = meta_data_create());
+    CHECK_ZERO(meta_data_add_signed_int(vl.meta, "i", i));
+    CHECK_ZERO(write_resolution_add(wr, &mixed_ds, &vl, &v));
+    meta_data_destroy(vl.meta);
+    vl.meta = NULL;
+  }
+
+  EXPECT_EQ_PTR(&mixed_ds, (void *)v.ds);
+  EXPECT_EQ_UINT64(TIME_T_TO_CDTIME_T(60), v.vl.time);
+  EXPECT_EQ_INT(300, (int)v.vl.values[0].derive);
+  EXPECT_EQ_INT(6, (int)v.vl.values[1].absolute);
+  int64_t i = 0;
+  CHECK_ZERO(meta_data_get_signed_int(v.vl.meta, "i", &i));
+  EXPECT_EQ_INT(3, (int)i);
+  write_resolution_value_free(&v);
+
+  /* The number of values must match the data set. */
+  vl.values_len = 1;
+  EXPECT_EQ_INT(EINVAL, write_resolution_add(wr, &mixed_ds, &vl, &v));
+
+  write_resolution_destroy(wr);
+  return 0;
+}
+
+DEF_TEST(gaps) {
+  write_resolution_t *wr = write_resolution_create(TIME_T_TO_CDTIME_T(10),
+                                                   WRITE_RESOLUTION_AVERAGE);
+  CHECK_NOT_NULL(wr);
+
+  write_resolution_value_t v;
+  CHECK_ZERO(add_gauge(wr, "a", 1.0, 1.0, &v));
+  CHECK_ZERO(add_gauge(wr, "a", 2.0, 3.0, &v));
+  EXPECT_EQ_PTR(NULL, (void *)v.ds);
+
+  /* A value of a later window consolidates the previous one. */
+  CHECK_ZERO(add_gauge(wr, "a", 25.0, 7.0, &v));
+  EXPECT_EQ_PTR(&gauge_ds, (void *)v.ds);
+  EXPECT_EQ_UINT64(TIME_T_TO_CDTIME_T(10), v.vl.time);
+  EXPECT_EQ_DOUBLE(2.0, v.vl.values[0].gauge);
+  write_resolution_value_free(&v);
+
+  /* Values of windows that have been written are dropped. */
+  CHECK_ZERO(add_gauge(wr, "a", 9.0, 100.0, &v));
+  EXPECT_EQ_PTR(NULL, (void *)v.ds);
+
+  write_resolution_value_t *vs = NULL;
+  size_t vs_num = 0;
+  CHECK_ZERO(write_resolution_flush(wr, 0, &vs, &vs_num));
+  EXPECT_EQ_UINT64(1, vs_num);
+  EXPECT_EQ_UINT64(TIME_T_TO_CDTIME_T(30), vs[0].vl.time);
+  EXPECT_EQ_DOUBLE(7.0, vs[0].vl.values[0].gauge);
+  write_resolution_values_free(vs, vs_num);
+
+  write_resolution_destroy(wr);
+  return 0;
+}
+
+DEF_TEST(flush) {
+  write_resolution_t *wr = write_resolution_create(TIME_T_TO_CDTIME_T(10),
+                                                   WRITE_RESOLUTION_AVERAGE);
+  CHECK_NOT_NULL(wr);
+
+  write_resolution_value_t v;
+  CHECK_ZERO(add_gauge(wr, "a", 1.0, 1.0, &v));
+  CHECK_ZERO(add_gauge(wr, "b", 2.0, 2.0, &v));
+  CHECK_ZERO(add_gauge(wr, "b", 12.0, 4.0, &v));
+  EXPECT_EQ_PTR(&gauge_ds, (void *)v.ds);
+  write_resolution_value_free(&v);
+
+  /* Windows are kept until a resolution after their end. */
+  write_resolution_value_t *vs = NULL;
+  size_t vs_num = 0;
+  CHECK_ZERO(write_resolution_flush(wr, TIME_T_TO_CDTIME_T(19), &vs, &vs_num));
+  EXPECT_EQ_UINT64(0, vs_num);
+  write_resolution_values_free(vs, vs_num);
+
+  CHECK_ZERO(write_resolution_flush(wr, TIME_T_TO_CDTIME_T(20), &vs, &vs_num));
+  EXPECT_EQ_UINT64(1, vs_num);
+  EXPECT_EQ_STR("a", vs[0].vl.type_instance);
+  EXPECT_EQ_UINT64(TIME_T_TO_CDTIME_T(10), vs[0].vl.time);
+  write_resolution_values_free(vs, vs_num);
+
+  /* Series "a" has been idle for two windows and is forgotten, so a late value
+   * starts over. */
+  CHECK_ZERO(write_resolution_flush(wr, TIME_T_TO_CDTIME_T(21), &vs, &vs_num));
+  EXPECT_EQ_UINT64(0, vs_num);
+  write_resolution_values_free(vs, vs_num);
+  CHECK_ZERO(add_gauge(wr, "a", 3.0, 5.0, &v));
+  EXPECT_EQ_PTR(NULL, (void *)v.ds);
+
+  CHECK_ZERO(write_resolution_flush(wr, 0, &vs, &vs_num));
+  EXPECT_EQ_UINT64(2, vs_num);
+  write_resolution_values_free(vs, vs_num);
+
+  write_resolution_destroy(wr);
+  return 0;
+}
+
+DEF_TEST(function_parse) {
+  write_resolution_function_t f = WRITE_RESOLUTION_AVERAGE;
+  CHECK_ZERO(write_resolution_function_parse("maximum", &f));
+  EXPECT_EQ_INT(WRITE_RESOLUTION_MAXIMUM, f);
+  EXPECT_EQ_INT(EINVAL, write_resolution_function_parse("Median", &f));
+  EXPECT_EQ_PTR(NULL, write_resolution_create(0, WRITE_RESOLUTION_LAST));
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(functions);
+  RUN_TEST(counters);
+  RUN_TEST(gaps);
+  RUN_TEST(flush);
+  RUN_TEST(function_parse);
+
+  END_TEST;
+}
@@ -0,0 +1,351 @@
+/**
+ * collectd - src/daemon/write_spool.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "utils/common/common.h"
+#include "utils/metadata/meta_data.h"
+#include "write_spool.h"
+
+#define WRITE_SPOOL_VERSION 1
+
+/* A record starts with this header, followed by `values_len' values, the five
+ * name fields (without terminating null bytes) and `meta_num' meta data
+ * entries. */
+typedef struct {
+  uint32_t version;
+  uint32_t values_len;
+  uint64_t time;
+  uint64_t interval;
+  uint16_t names_len[5];
+  uint16_t meta_num;
+  uint32_t reserved;
+} record_header_t;
+
+/* Each meta data entry is this header, followed by the key and the value:
+ * the bytes of a string, one byte for a boolean and eight bytes otherwise. */
+typedef struct {
+  uint8_t type;
+  uint8_t reserved;
+  uint16_t key_len;
+  uint32_t value_len;
+} record_meta_t;
+
+typedef struct {
+  char *data;
+  size_t len;
+  size_t size;
+} wbuf_t;
+
+typedef struct {
+  char const *data;
+  size_t len;
+  size_t pos;
+} rbuf_t;
+
+static int wbuf_add(wbuf_t *b, void const *p, size_t n) /* {{{ */
+{
+  if (b->len + n > b->size) {
+    size_t size = (b->size == 0) ? 256 : b->size;
+    while (size < b->len + n)
+      size *= 2;
+
+    char *tmp = realloc(b->data, size);
+    if (tmp == NULL)
+      return ENOMEM;
+    b->data = tmp;
+    b->size = size;
+  }
+
+  memcpy(b->data + b->len, p, n);
+  b->len += n;
+  return 0;
+} /* }}} int wbuf_add */
+
+/* Returns a pointer to the next `n' bytes, or NULL if the record is too
+ * short. */
+static char const *rbuf_get(rbuf_t *r, size_t n) /* {{{ */
+{
+  if (n > r->len - r->pos)
+    return NULL;
+
+  char const *p = r->data + r->pos;
+  r->pos += n;
+  return p;
+} /* }}} char const *rbuf_get */
+
+static char *vl_name_field(value_list_t *vl, size_t i) /* {{{ */
+{
+  char *fields[] = {vl->host, vl->plugin, vl->plugin_instance, vl->type,
+                    vl->type_instance};
+  return fields[i];
+} /* }}} char *vl_name_field */
+
+static int encode_meta_entry(wbuf_t *b, meta_data_t *md, /* {{{ */
+                             char const *key) {
+  size_t key_len = strlen(key);
+  if (key_len > UINT16_MAX)
+    return EINVAL;
+
+  record_meta_t m = {
+      .type = (uint8_t)meta_data_type(md, key),
+      .key_len = (uint16_t)key_len,
+  };
+  union {
+    int64_t i;
+    uint64_t u;
+    double d;
+  } num_value;
+  char *str = NULL;
+  bool bool_value = false;
+  uint8_t byte;
+  void const *value = &num_value;
+  int status;
+
+  switch (m.type) {
+  case MD_TYPE_STRING:
+    status = meta_data_get_string(md, key, &str);
+    value = str;
+    m.value_len = (str != NULL) ? (uint32_t)strlen(str) : 0;
+    break;
+  case MD_TYPE_SIGNED_INT:
+    status = meta_data_get_signed_int(md, key, &num_value.i);
+    m.value_len = sizeof(num_value);
+    break;
+  case MD_TYPE_UNSIGNED_INT:
+    status = meta_data_get_unsigned_int(md, key, &num_value.u);
+    m.value_len = sizeof(num_value);
+    break;
+  case MD_TYPE_DOUBLE:
+    status = meta_data_get_double(md, key, &num_value.d);
+    m.value_len = sizeof(num_value);
+    break;
+  case MD_TYPE_BOOLEAN:
+    status = meta_data_get_boolean(md, key, &bool_value);
+    byte = bool_value ? 1 : 0;
+    value = &byte;
+    m.value_len = 1;
+    break;
+  default:
+    return EINVAL;
+  }
+  if (status != 0) {
+    sfree(str);
+    return EINVAL;
+  }
+
+  status = wbuf_add(b, &m, sizeof(m));
+  if (status == 0)
+    status = wbuf_add(b, key, m.key_len);
+  if ((status == 0) && (m.value_len > 0))
+    status = wbuf_add(b, value, m.value_len);
+
+  sfree(str);
+  return status;
+} /* }}} int encode_meta_entry */
+
+static int encode_meta(wbuf_t *b, meta_data_t *md, /* {{{ */
+                       uint16_t *ret_num) {
+  char **toc = NULL;
+  int toc_num = meta_data_toc(md, &toc);
+  if (toc_num < 0)
+    return EINVAL;
+
+  int status = (toc_num > UINT16_MAX) ? EINVAL : 0;
+  for (int i = 0; i < toc_num; i++) {
+    if (status == 0)
+      status = encode_meta_entry(b, md, toc[i]);
+    sfree(toc[i]);
+  }
+  sfree(toc);
+
+  *ret_num = (uint16_t)toc_num;
+  return status;
+} /* }}} int encode_meta */
+
+int write_spool_encode(value_list_t const *vl, void **ret_buf, /* {{{ */
+                       size_t *ret_len) {
+  if ((vl == NULL) || (ret_buf == NULL) || (ret_len == NULL) ||
+      (vl->values_len == 0) || (vl->values_len > UINT32_MAX))
+    return EINVAL;
+
+  value_list_t *v = (value_list_t *)vl;
+  record_header_t hdr = {
+      .version = WRITE_SPOOL_VERSION,
+      .values_len = (uint32_t)vl->values_len,
+      .time = (uint64_t)vl->time,
+      .interval = (uint64_t)vl->interval,
+  };
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(hdr.names_len); i++)
+    hdr.names_len[i] = (uint16_t)strnlen(vl_name_field(v, i),
+                                         DATA_MAX_NAME_LEN);
+
+  wbuf_t b = {0};
+  int status = wbuf_add(&b, &hdr, sizeof(hdr));
+  if (status == 0)
+    status = wbuf_add(&b, vl->values, vl->values_len * sizeof(*vl->values));
+  for (size_t i = 0; (status == 0) && (i < STATIC_ARRAY_SIZE(hdr.names_len));
+       i++)
+    status = wbuf_add(&b, vl_name_field(v, i), hdr.names_len[i]);
+  if ((status == 0) && (vl->meta != NULL))
+    status = encode_meta(&b, vl->meta, &hdr.meta_num);
+
+  if (status != 0) {
+    sfree(b.data);
+    return status;
+  }
+
+  /* The number of meta data entries is known now. */
+  memcpy(b.data, &hdr, sizeof(hdr));
+
+  *ret_buf = b.data;
+  *ret_len = b.len;
+  return 0;
+} /* }}} int write_spool_encode */
+
+static int decode_meta(rbuf_t *r, meta_data_t *md) /* {{{ */
+{
+  record_meta_t m;
+  char const *p = rbuf_get(r, sizeof(m));
+  if (p == NULL)
+    return EINVAL;
+  memcpy(&m, p, sizeof(m));
+
+  char const *key = rbuf_get(r, m.key_len);
+  char const *value = rbuf_get(r, m.value_len);
+  if ((key == NULL) || (value == NULL) || (m.key_len == 0))
+    return EINVAL;
+
+  union {
+    int64_t i;
+    uint64_t u;
+    double d;
+  } num_value = {0};
+  if (m.value_len == sizeof(num_value))
+    memcpy(&num_value, value, sizeof(num_value));
+  else if ((m.type != MD_TYPE_STRING) && (m.type != MD_TYPE_BOOLEAN))
+    return EINVAL;
+
+  char *key_str = sstrndup(key, m.key_len);
+  if (key_str == NULL)
+    return ENOMEM;
+
+  int status;
+  switch (m.type) {
+  case MD_TYPE_STRING: {
+    char *str = sstrndup(value, m.value_len);
+    status = (str != NULL) ? meta_data_add_string(md, key_str, str) : -1;
+    sfree(str);
+    break;
+  }
+  case MD_TYPE_SIGNED_INT:
+    status = meta_data_add_signed_int(md, key_str, num_value.i);
+    break;
+  case MD_TYPE_UNSIGNED_INT:
+    status = meta_data_add_unsigned_int(md, key_str, num_value.u);
+    break;
+  case MD_TYPE_DOUBLE:
+    status = meta_data_add_double(md, key_str, num_value.d);
+    break;
+  case MD_TYPE_BOOLEAN:
+    status = (m.value_len == 1)
+                 ? meta_data_add_boolean(md, key_str, value[0] != 0)
+                 : -1;
+    break;
+  default:
+    status = -1;
+  }
+
+  sfree(key_str);
+  return (status == 0) ? 0 : EINVAL;
+} /* }}} int decode_meta */
+
+int write_spool_decode(void const *buf, size_t len, /* {{{ */
+                       value_list_t *vl) {
+  if ((buf == NULL) || (vl == NULL))
+    return EINVAL;
+
+  rbuf_t r = {.data = buf, .len = len};
+  record_header_t hdr;
+  char const *p = rbuf_get(&r, sizeof(hdr));
+  if (p == NULL)
+    return EINVAL;
+  memcpy(&hdr, p, sizeof(hdr));
+
+  if ((hdr.version != WRITE_SPOOL_VERSION) || (hdr.values_len == 0) ||
+      (hdr.values_len > (len - r.pos) / sizeof(value_t)))
+    return EINVAL;
+
+  *vl = (value_list_t){
+      .values_len = hdr.values_len,
+      .time = (cdtime_t)hdr.time,
+      .interval = (cdtime_t)hdr.interval,
+  };
+
+  p = rbuf_get(&r, hdr.values_len * sizeof(value_t));
+  vl->values = malloc(hdr.values_len * sizeof(value_t));
+  if (vl->values == NULL)
+    return ENOMEM;
+  memcpy(vl->values, p, hdr.values_len * sizeof(value_t));
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(hdr.names_len); i++) {
+    p = rbuf_get(&r, hdr.names_len[i]);
+    if ((p == NULL) || (hdr.names_len[i] >= DATA_MAX_NAME_LEN)) {
+      write_spool_free(vl);
+      return EINVAL;
+    }
+    char *field = vl_name_field(vl, i);
+    memcpy(field, p, hdr.names_len[i]);
+    field[hdr.names_len[i]] = 0;
+  }
+
+  if (hdr.meta_num > 0) {
+    vl->meta = meta_data_create();
+    if (vl->meta == NULL) {
+      write_spool_free(vl);
+      return ENOMEM;
+    }
+  }
+  for (uint16_t i = 0; i < hdr.meta_num; i++) {
+    int status = decode_meta(&r, vl->meta);
+    if (status != 0) {
+      write_spool_free(vl);
+      return status;
+    }
+  }
+
+  return 0;
+} /* }}} int write_spool_decode */
+
+void write_spool_free(value_list_t *vl) /* {{{ */
+{
+  if (vl == NULL)
+    return;
+
+  sfree(vl->values);
+  vl->values_len = 0;
+  if (vl->meta != NULL) {
+    meta_data_destroy(vl->meta);
+    vl->meta = NULL;
+  }
+} /* }}} void write_spool_free */
@@ -0,0 +1,67 @@
+/**
+ * collectd - src/daemon/write_spool.h
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef WRITE_SPOOL_H
+#define WRITE_SPOOL_H 1
+
+#include "plugin.h"
+
+/*
+ * Records of the write queue's disk spool (see "WriteQueueSpool"). A record
+ * holds one value list: its identifier, time, interval, values and meta data.
+ * Records are only read by the daemon that wrote them, so they use the host's
+ * byte order; records of another format version are rejected.
+ */
+
+/*
+ * NAME
+ *   write_spool_encode
+ *
+ * DESCRIPTION
+ *   Serializes `vl' into a newly allocated buffer, which the caller must
+ *   free. The time, interval and host of `vl' must be set.
+ *
+ * RETURN VALUE
+ *   Zero upon success, EINVAL if `vl' can not be encoded or ENOMEM.
+ */
+int write_spool_encode(value_list_t const *vl, void **ret_buf,
+                       size_t *ret_len);
+
+/*
+ * NAME
+ *   write_spool_decode
+ *
+ * DESCRIPTION
+ *   Parses a record written by write_spool_encode() into `vl'. The values and
+ *   meta data are allocated and must be freed with write_spool_free().
+ *
+ * RETURN VALUE
+ *   Zero upon success, EINVAL if the record is broken or ENOMEM.
+ */
+int write_spool_decode(void const *buf, size_t len, value_list_t *vl);
+
+/* Frees the values and meta data of a value list returned by
+ * write_spool_decode(). */
+void write_spool_free(value_list_t *vl);
+
+#endif /* WRITE_SPOOL_H */
@@ -0,0 +1,140 @@
+/**
+ * collectd - src/daemon/write_spool_test.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/common/common.h"
+#include "utils/metadata/meta_data.h"
+#include "write_spool.h"
+
+static void fill_vl(value_list_t *vl, value_t *values) {
+  *vl = (value_list_t){
+      .values = values,
+      .values_len = 2,
+      .time = TIME_T_TO_CDTIME_T(1500000000),
+      .interval = MS_TO_CDTIME_T(2500),
+  };
+  values[0].derive = -42;
+  values[1].gauge = 3.25;
+  sstrncpy(vl->host, "example.com", sizeof(vl->host));
+  sstrncpy(vl->plugin, "test", sizeof(vl->plugin));
+  sstrncpy(vl->type, "if_octets", sizeof(vl->type));
+  sstrncpy(vl->type_instance, "eth0", sizeof(vl->type_instance));
+}
+
+DEF_TEST(round_trip) {
+  value_t values[2];
+  value_list_t vl;
+  fill_vl(&vl, values);
+
+  CHECK_NOT_NULL(vl.meta = meta_data_create());
+  CHECK_ZERO(meta_data_add_string(vl.meta, "string", "foo bar"));
+  CHECK_ZERO(meta_data_add_string(vl.meta, "empty", ""));
+  CHECK_ZERO(meta_data_add_signed_int(vl.meta, "signed", -1));
+  CHECK_ZERO(meta_data_add_unsigned_int(vl.meta, "unsigned", UINT64_MAX));
+  CHECK_ZERO(meta_data_add_double(vl.meta, "double", 0.5));
+  CHECK_ZERO(meta_data_add_boolean(vl.meta, "boolean", true));
+
+  void *buf = NULL;
+  size_t len = 0;
+  CHECK_ZERO(write_spool_encode(&vl, &buf, &len));
+
+  value_list_t got;
+  CHECK_ZERO(write_spool_decode(buf, len, &got));
+
+  EXPECT_EQ_STR(vl.host, got.host);
+  EXPECT_EQ_STR(vl.plugin, got.plugin);
+  EXPECT_EQ_STR("", got.plugin_instance);
+  EXPECT_EQ_STR(vl.type, got.type);
+  EXPECT_EQ_STR(vl.type_instance, got.type_instance);
+  EXPECT_EQ_UINT64(vl.time, got.time);
+  EXPECT_EQ_UINT64(vl.interval, got.interval);
+  EXPECT_EQ_UINT64(2, got.values_len);
+  EXPECT_EQ_INT(-42, (int)got.values[0].derive);
+  EXPECT_EQ_DOUBLE(3.25, got.values[1].gauge);
+
+  char *s = NULL;
+  CHECK_ZERO(meta_data_get_string(got.meta, "string", &s));
+  EXPECT_EQ_STR("foo bar", s);
+  sfree(s);
+  CHECK_ZERO(meta_data_get_string(got.meta, "empty", &s));
+  EXPECT_EQ_STR("", s);
+  sfree(s);
+  int64_t si = 0;
+  CHECK_ZERO(meta_data_get_signed_int(got.meta, "signed", &si));
+  EXPECT_EQ_INT(-1, (int)si);
+  uint64_t ui = 0;
+  CHECK_ZERO(meta_data_get_unsigned_int(got.meta, "unsigned", &ui));
+  EXPECT_EQ_UINT64(UINT64_MAX, ui);
+  double d = 0;
+  CHECK_ZERO(meta_data_get_double(got.meta, "double", &d));
+  EXPECT_EQ_DOUBLE(0.5, d);
+  bool b = false;
+  CHECK_ZERO(meta_data_get_boolean(got.meta, "boolean", &b));
+  OK(b);
+
+  /* Every truncated record is rejected. */
+  for (size_t i = 0; i < len; i++) {
+    value_list_t broken;
+    EXPECT_EQ_INT(EINVAL, write_spool_decode(buf, i, &broken));
+  }
+
+  write_spool_free(&got);
+  meta_data_destroy(vl.meta);
+  sfree(buf);
+  return 0;
+}
+
+DEF_TEST(no_meta) {
+  value_t values[2];
+  value_list_t vl;
+  fill_vl(&vl, values);
+
+  void *buf = NULL;
+  size_t len = 0;
+  CHECK_ZERO(write_spool_encode(&vl, &buf, &len));
+
+  value_list_t got;
+  CHECK_ZERO(write_spool_decode(buf, len, &got));
+  EXPECT_EQ_PTR(NULL, got.meta);
+  EXPECT_EQ_STR(vl.type_instance, got.type_instance);
+  write_spool_free(&got);
+
+  /* Records of another version are rejected. */
+  ((uint32_t *)buf)[0]++;
+  EXPECT_EQ_INT(EINVAL, write_spool_decode(buf, len, &got));
+
+  sfree(buf);
+
+  vl.values_len = 0;
+  EXPECT_EQ_INT(EINVAL, write_spool_encode(&vl, &buf, &len));
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(round_trip);
+  RUN_TEST(no_meta);
+
+  END_TEST;
+}
@@ -24,9 +24,17 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 #include "utils/ignorelist/ignorelist.h"
 #include "utils/mount/mount.h"
+#include "utils_complain.h"
+
+#if KERNEL_LINUX
+#include <fcntl.h>
+#include <poll.h>
+#define DF_MOUNTINFO "/proc/self/mountinfo"
+#endif
 
 #if HAVE_STATVFS
 #if HAVE_SYS_STATVFS_H
@@ -34,6 +42,7 @@
 #endif
 #define STATANYFS statvfs
 #define STATANYFS_STR "statvfs"
+typedef struct statvfs statanyfs_t;
 #define BLOCKSIZE(s) ((s).f_frsize ? (s).f_frsize : (s).f_bsize)
 #elif HAVE_STATFS
 #if HAVE_SYS_STATFS_H
@@ -41,6 +50,7 @@
 #endif
 #define STATANYFS statfs
 #define STATANYFS_STR "statfs"
+typedef struct statfs statanyfs_t;
 #define BLOCKSIZE(s) (s).f_bsize
 #else
 #error "No applicable input method."
@@ -49,7 +59,8 @@
 static const char *config_keys[] = {
     "Device",         "MountPoint",       "FSType",
     "IgnoreSelected", "ReportByDevice",   "ReportInodes",
-    "ValuesAbsolute", "ValuesPercentage", "LogOnce"};
+    "ValuesAbsolute", "ValuesPercentage", "LogOnce",
+    "Threads",        "Timeout"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static ignorelist_t *il_device;
@@ -63,6 +74,51 @@ static bool values_absolute = true;
 static bool values_percentage;
 static bool log_once;
 
+/* Number of threads calling STATANYFS() and how long a read waits for them.
+ * A timeout of zero means "half the read interval". */
+static int df_threads_num = 4;
+static cdtime_t df_timeout;
+
+/* Per file system state shared with the stat workers. All fields but
+ * "complaint" are protected by "df_lock". */
+typedef struct df_stat_s {
+  char *dir;
+  bool queued; /* waiting in the work queue */
+  bool busy;   /* a worker is inside STATANYFS() */
+  uint64_t round;
+  uint64_t done; /* value of "round" when the last call returned */
+  int status;
+  int err;
+  statanyfs_t buf;
+  c_complain_t complaint;
+  struct df_stat_s *next;
+} df_stat_t;
+
+static pthread_mutex_t df_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t df_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t df_done_cond = PTHREAD_COND_INITIALIZER;
+static c_avl_tree_t *df_stats;
+static df_stat_t *df_queue_head;
+static df_stat_t *df_queue_tail;
+static uint64_t df_round;
+static int df_workers;
+static bool df_stopping;
+
+/* The mount list is kept between reads. On Linux it is only parsed again
+ * once the kernel reports a change in the mount table. */
+static cu_mount_t *df_mounts;
+#if KERNEL_LINUX
+static int df_mountinfo_fd = -1;
+#endif
+
+typedef struct {
+  cu_mount_t *mnt;
+  df_stat_t *st;
+  int status;
+  int err;
+  statanyfs_t buf;
+} df_target_t;
+
 static int df_init(void) {
   if (il_device == NULL)
     il_device = ignorelist_create(1);
@@ -135,6 +191,22 @@ static int df_config(const char *key, const char *value) {
       log_once = false;
 
     return 0;
+  } else if (strcasecmp(key, "Threads") == 0) {
+    int tmp = atoi(value);
+    if (tmp < 1) {
+      ERROR("df plugin: Threads must be at least one.");
+      return 1;
+    }
+    df_threads_num = tmp;
+    return 0;
+  } else if (strcasecmp(key, "Timeout") == 0) {
+    double tmp = atof(value);
+    if (tmp < 0.0) {
+      ERROR("df plugin: Timeout must not be negative.");
+      return 1;
+    }
+    df_timeout = DOUBLE_TO_CDTIME_T(tmp);
+    return 0;
   }
 
   return -1;
@@ -158,30 +230,352 @@ __attribute__((nonnull(2))) static void df_submit_one(char *plugin_instance,
   plugin_dispatch_values(&vl);
 } /* void df_submit_one */
 
-static int df_read(void) {
+static void df_stat_free(df_stat_t *st) {
+  if (st == NULL)
+    return;
+
+  sfree(st->dir);
+  sfree(st);
+} /* void df_stat_free */
+
+static void *df_worker(void __attribute__((unused)) * arg) /* {{{ */
+{
+  pthread_mutex_lock(&df_lock);
+  while (!df_stopping) {
+    df_stat_t *st = df_queue_head;
+    if (st == NULL) {
+      pthread_cond_wait(&df_work_cond, &df_lock);
+      continue;
+    }
+
+    df_queue_head = st->next;
+    if (df_queue_head == NULL)
+      df_queue_tail = NULL;
+    st->next = NULL;
+    st->queued = false;
+    st->busy = true;
+    pthread_mutex_unlock(&df_lock);
+
+    /* This may block for a long time, e.g. on an unreachable NFS server. The
+     * entry stays alive while "busy" is set. */
+    statanyfs_t buf = {0};
+    int status = STATANYFS(st->dir, &buf);
+    int err = (status < 0) ? errno : 0;
+
+    pthread_mutex_lock(&df_lock);
+    st->buf = buf;
+    st->status = status;
+    st->err = err;
+    st->done = st->round;
+    st->busy = false;
+    pthread_cond_broadcast(&df_done_cond);
+  }
+
+  df_workers--;
+  pthread_cond_broadcast(&df_done_cond);
+  pthread_mutex_unlock(&df_lock);
+  return NULL;
+} /* }}} void *df_worker */
+
+/* Must be called with "df_lock" held. */
+static int df_workers_start(void) /* {{{ */
+{
+  if (df_stats == NULL) {
+    df_stats = c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (df_stats == NULL)
+      return ENOMEM;
+  }
+
+  while (df_workers < df_threads_num) {
+    pthread_t tid;
+    int status = plugin_thread_create(&tid, df_worker, NULL, "df stat");
+    if (status != 0) {
+      ERROR("df plugin: plugin_thread_create failed: %s", STRERROR(status));
+      return (df_workers > 0) ? 0 : status;
+    }
+    pthread_detach(tid);
+    df_workers++;
+  }
+
+  return 0;
+} /* }}} int df_workers_start */
+
+/* Queues one STATANYFS() call per target and waits until all of them
+ * returned or the timeout passed. Targets that did not return in time get
+ * status -1 and err ETIMEDOUT. A call that is still running from an earlier
+ * read is not queued again, so a hung file system ties up at most one
+ * worker. */
+static int df_stat_targets(df_target_t *targets, size_t targets_num) /* {{{ */
+{
+  cdtime_t timeout = df_timeout;
+  if (timeout == 0)
+    timeout = plugin_get_interval() / 2;
+  struct timespec deadline = CDTIME_T_TO_TIMESPEC(cdtime() + timeout);
+
+  pthread_mutex_lock(&df_lock);
+  int status = df_workers_start();
+  if (status != 0) {
+    pthread_mutex_unlock(&df_lock);
+    return status;
+  }
+
+  uint64_t round = ++df_round;
+  for (size_t i = 0; i < targets_num; i++) {
+    df_stat_t *st = NULL;
+    if (c_avl_get(df_stats, targets[i].mnt->dir, (void *)&st) != 0) {
+      st = calloc(1, sizeof(*st));
+      if (st == NULL || (st->dir = strdup(targets[i].mnt->dir)) == NULL) {
+        sfree(st);
+        continue;
+      }
+      C_COMPLAIN_INIT(&st->complaint);
+      if (c_avl_insert(df_stats, st->dir, st) != 0) {
+        df_stat_free(st);
+        continue;
+      }
+    }
+
+    targets[i].st = st;
+    st->round = round;
+    if (st->queued || st->busy)
+      continue;
+
+    st->queued = true;
+    if (df_queue_tail == NULL)
+      df_queue_head = st;
+    else
+      df_queue_tail->next = st;
+    df_queue_tail = st;
+  }
+  pthread_cond_broadcast(&df_work_cond);
+
+  bool timed_out = false;
+  while (!timed_out) {
+    bool pending = false;
+    for (size_t i = 0; i < targets_num; i++) {
+      if (targets[i].st != NULL && targets[i].st->done != round) {
+        pending = true;
+        break;
+      }
+    }
+    if (!pending)
+      break;
+
+    if (pthread_cond_timedwait(&df_done_cond, &df_lock, &deadline) ==
+        ETIMEDOUT)
+      timed_out = true;
+  }
+
+  for (size_t i = 0; i < targets_num; i++) {
+    df_stat_t *st = targets[i].st;
+    if (st == NULL) {
+      targets[i].status = -1;
+      targets[i].err = ENOMEM;
+    } else if (st->done != round) {
+      targets[i].status = -1;
+      targets[i].err = ETIMEDOUT;
+    } else {
+      targets[i].status = st->status;
+      targets[i].err = st->err;
+      targets[i].buf = st->buf;
+    }
+  }
+
+  /* Forget about file systems that are no longer mounted or selected. */
+  df_stat_t *stale = NULL;
+  c_avl_iterator_t *iter = c_avl_get_iterator(df_stats);
+  char *key;
+  df_stat_t *st;
+  while (c_avl_iterator_next(iter, (void *)&key, (void *)&st) == 0) {
+    if (st->round == round || st->queued || st->busy)
+      continue;
+    st->next = stale;
+    stale = st;
+  }
+  c_avl_iterator_destroy(iter);
+
+  while (stale != NULL) {
+    st = stale;
+    stale = st->next;
+    c_avl_remove(df_stats, st->dir, NULL, NULL);
+    df_stat_free(st);
+  }
+
+  pthread_mutex_unlock(&df_lock);
+  return 0;
+} /* }}} int df_stat_targets */
+
+/* Re-reads the mount table if it may have changed since the last call. */
+static int df_mounts_update(void) /* {{{ */
+{
+#if KERNEL_LINUX
+  if (df_mountinfo_fd < 0) {
+    /* Open before parsing the list so no change can be missed. If this
+     * fails, the mount table is read on every interval. */
+    df_mountinfo_fd = open(DF_MOUNTINFO, O_RDONLY | O_CLOEXEC);
+    if (df_mountinfo_fd < 0)
+      DEBUG("df plugin: open(" DF_MOUNTINFO ") failed: %s", STRERRNO);
+  } else if (df_mounts != NULL) {
+    /* The kernel flags POLLPRI|POLLERR once after every change of the mount
+     * table; the poll itself acknowledges the event. */
+    struct pollfd pfd = {.fd = df_mountinfo_fd, .events = POLLPRI};
+    int status = poll(&pfd, 1, 0);
+    if (status == 0 ||
+        (status > 0 && (pfd.revents & (POLLPRI | POLLERR)) == 0))
+      return 0;
+  }
+#endif
+
+  cu_mount_freelist(df_mounts);
+  df_mounts = NULL;
+  if (cu_mount_getlist(&df_mounts) == NULL) {
+    ERROR("df plugin: cu_mount_getlist failed.");
+    return -1;
+  }
+
+  return 0;
+} /* }}} int df_mounts_update */
+
+static int df_submit_fs(cu_mount_t *mnt_ptr, char const *dev,
+                        statanyfs_t *statbuf) {
+  unsigned long long blocksize;
+  char disk_name[256];
+  uint64_t blk_free;
+  uint64_t blk_reserved;
+  uint64_t blk_used;
+
+  if (!statbuf->f_blocks)
+    return 0;
+
+  if (by_device) {
+    /* eg, /dev/hda1  -- strip off the "/dev/" */
+    if (strncmp(dev, "/dev/", strlen("/dev/")) == 0)
+      sstrncpy(disk_name, dev + strlen("/dev/"), sizeof(disk_name));
+    else
+      sstrncpy(disk_name, dev, sizeof(disk_name));
+
+    if (strlen(disk_name) < 1) {
+      DEBUG("df: no device name for mountpoint %s, skipping", mnt_ptr->dir);
+      return 0;
+    }
+  } else {
+    if (strcmp(mnt_ptr->dir, "/") == 0)
+      sstrncpy(disk_name, "root", sizeof(disk_name));
+    else {
+      sstrncpy(disk_name, mnt_ptr->dir + 1, sizeof(disk_name));
+      size_t len = strlen(disk_name);
+
+      for (size_t i = 0; i < len; i++)
+        if (disk_name[i] == '/')
+          disk_name[i] = '-';
+    }
+  }
+
+  blocksize = BLOCKSIZE(*statbuf);
+
+/*
+ * Sanity-check for the values in the struct
+ */
+/* Check for negative "available" byes. For example UFS can
+ * report negative free space for user. Notice. blk_reserved
+ * will start to diminish after this. */
 #if HAVE_STATVFS
-  struct statvfs statbuf;
+  /* Cast and temporary variable are needed to avoid
+   * compiler warnings.
+   * ((struct statvfs).f_bavail is unsigned (POSIX)) */
+  int64_t signed_bavail = (int64_t)statbuf->f_bavail;
+  if (signed_bavail < 0)
+    statbuf->f_bavail = 0;
 #elif HAVE_STATFS
-  struct statfs statbuf;
+  if (statbuf->f_bavail < 0)
+    statbuf->f_bavail = 0;
 #endif
+  /* Make sure that f_blocks >= f_bfree >= f_bavail */
+  if (statbuf->f_bfree < statbuf->f_bavail)
+    statbuf->f_bfree = statbuf->f_bavail;
+  if (statbuf->f_blocks < statbuf->f_bfree)
+    statbuf->f_blocks = statbuf->f_bfree;
+
+  blk_free = (uint64_t)statbuf->f_bavail;
+  blk_reserved = (uint64_t)(statbuf->f_bfree - statbuf->f_bavail);
+  blk_used = (uint64_t)(statbuf->f_blocks - statbuf->f_bfree);
+
+  if (values_absolute) {
+    df_submit_one(disk_name, "df_complex", "free",
+                  (gauge_t)(blk_free * blocksize));
+    df_submit_one(disk_name, "df_complex", "reserved",
+                  (gauge_t)(blk_reserved * blocksize));
+    df_submit_one(disk_name, "df_complex", "used",
+                  (gauge_t)(blk_used * blocksize));
+  }
+
+  if (values_percentage) {
+    if (statbuf->f_blocks > 0) {
+      df_submit_one(disk_name, "percent_bytes", "free",
+                    (gauge_t)((float_t)(blk_free) / statbuf->f_blocks * 100));
+      df_submit_one(
+          disk_name, "percent_bytes", "reserved",
+          (gauge_t)((float_t)(blk_reserved) / statbuf->f_blocks * 100));
+      df_submit_one(disk_name, "percent_bytes", "used",
+                    (gauge_t)((float_t)(blk_used) / statbuf->f_blocks * 100));
+    } else {
+      return -1;
+    }
+  }
+
+  /* inode handling */
+  if (report_inodes && statbuf->f_files != 0 && statbuf->f_ffree != 0) {
+    uint64_t inode_free;
+    uint64_t inode_reserved;
+    uint64_t inode_used;
+
+    /* Sanity-check for the values in the struct */
+    if (statbuf->f_ffree < statbuf->f_favail)
+      statbuf->f_ffree = statbuf->f_favail;
+    if (statbuf->f_files < statbuf->f_ffree)
+      statbuf->f_files = statbuf->f_ffree;
+
+    inode_free = (uint64_t)statbuf->f_favail;
+    inode_reserved = (uint64_t)(statbuf->f_ffree - statbuf->f_favail);
+    inode_used = (uint64_t)(statbuf->f_files - statbuf->f_ffree);
+
+    if (values_percentage) {
+      if (statbuf->f_files > 0) {
+        df_submit_one(
+            disk_name, "percent_inodes", "free",
+            (gauge_t)((float_t)(inode_free) / statbuf->f_files * 100));
+        df_submit_one(
+            disk_name, "percent_inodes", "reserved",
+            (gauge_t)((float_t)(inode_reserved) / statbuf->f_files * 100));
+        df_submit_one(
+            disk_name, "percent_inodes", "used",
+            (gauge_t)((float_t)(inode_used) / statbuf->f_files * 100));
+      } else {
+        return -1;
+      }
+    }
+    if (values_absolute) {
+      df_submit_one(disk_name, "df_inodes", "free", (gauge_t)inode_free);
+      df_submit_one(disk_name, "df_inodes", "reserved",
+                    (gauge_t)inode_reserved);
+      df_submit_one(disk_name, "df_inodes", "used", (gauge_t)inode_used);
+    }
+  }
+
+  return 0;
+} /* int df_submit_fs */
+
+static int df_read(void) {
   int retval = 0;
-  /* struct STATANYFS statbuf; */
-  cu_mount_t *mnt_list;
+  df_target_t *targets = NULL;
+  size_t targets_num = 0;
 
-  mnt_list = NULL;
-  if (cu_mount_getlist(&mnt_list) == NULL) {
-    ERROR("df plugin: cu_mount_getlist failed.");
+  if (df_mounts_update() != 0)
     return -1;
-  }
 
-  for (cu_mount_t *mnt_ptr = mnt_list; mnt_ptr != NULL;
+  for (cu_mount_t *mnt_ptr = df_mounts; mnt_ptr != NULL;
        mnt_ptr = mnt_ptr->next) {
-    unsigned long long blocksize;
-    char disk_name[256];
     cu_mount_t *dup_ptr;
-    uint64_t blk_free;
-    uint64_t blk_reserved;
-    uint64_t blk_used;
 
     char const *dev =
         (mnt_ptr->spec_device != NULL) ? mnt_ptr->spec_device : mnt_ptr->device;
@@ -194,7 +588,7 @@ static int df_read(void) {
       continue;
 
     /* search for duplicates *in front of* the current mnt_ptr. */
-    for (dup_ptr = mnt_list; dup_ptr != NULL; dup_ptr = dup_ptr->next) {
+    for (dup_ptr = df_mounts; dup_ptr != NULL; dup_ptr = dup_ptr->next) {
       /* No duplicate found: mnt_ptr is the first of its kind. */
       if (dup_ptr == mnt_ptr) {
         dup_ptr = NULL;
@@ -214,12 +608,50 @@ static int df_read(void) {
     if (dup_ptr != NULL)
       continue;
 
-    if (STATANYFS(mnt_ptr->dir, &statbuf) < 0) {
+    df_target_t *tmp = realloc(targets, (targets_num + 1) * sizeof(*targets));
+    if (tmp == NULL) {
+      ERROR("df plugin: realloc failed.");
+      sfree(targets);
+      return -1;
+    }
+    targets = tmp;
+    targets[targets_num] = (df_target_t){.mnt = mnt_ptr};
+    targets_num++;
+  }
+
+  if (targets_num == 0)
+    return 0;
+
+  int status = df_stat_targets(targets, targets_num);
+  if (status != 0) {
+    sfree(targets);
+    return -1;
+  }
+
+  for (size_t i = 0; i < targets_num; i++) {
+    cu_mount_t *mnt_ptr = targets[i].mnt;
+    char const *dev =
+        (mnt_ptr->spec_device != NULL) ? mnt_ptr->spec_device : mnt_ptr->device;
+
+    if (targets[i].err == ETIMEDOUT && targets[i].st != NULL) {
+      c_complain(LOG_WARNING, &targets[i].st->complaint,
+                 "df plugin: " STATANYFS_STR "(%s) did not return in time, "
+                 "skipping this file system.",
+                 mnt_ptr->dir);
+      continue;
+    } else if (targets[i].st != NULL) {
+      c_release(LOG_INFO, &targets[i].st->complaint,
+                "df plugin: " STATANYFS_STR "(%s) is responding again.",
+                mnt_ptr->dir);
+    }
+
+    if (targets[i].status < 0) {
       if (log_once == false || ignorelist_match(il_errors, mnt_ptr->dir) == 0) {
         if (log_once == true) {
           ignorelist_add(il_errors, mnt_ptr->dir);
         }
-        ERROR(STATANYFS_STR "(%s) failed: %s", mnt_ptr->dir, STRERRNO);
+        ERROR(STATANYFS_STR "(%s) failed: %s", mnt_ptr->dir,
+              STRERROR(targets[i].err));
       }
       continue;
     } else {
@@ -228,134 +660,61 @@ static int df_read(void) {
       }
     }
 
-    if (!statbuf.f_blocks)
-      continue;
-
-    if (by_device) {
-      /* eg, /dev/hda1  -- strip off the "/dev/" */
-      if (strncmp(dev, "/dev/", strlen("/dev/")) == 0)
-        sstrncpy(disk_name, dev + strlen("/dev/"), sizeof(disk_name));
-      else
-        sstrncpy(disk_name, dev, sizeof(disk_name));
-
-      if (strlen(disk_name) < 1) {
-        DEBUG("df: no device name for mountpoint %s, skipping", mnt_ptr->dir);
-        continue;
-      }
-    } else {
-      if (strcmp(mnt_ptr->dir, "/") == 0)
-        sstrncpy(disk_name, "root", sizeof(disk_name));
-      else {
-        sstrncpy(disk_name, mnt_ptr->dir + 1, sizeof(disk_name));
-        size_t len = strlen(disk_name);
-
-        for (size_t i = 0; i < len; i++)
-          if (disk_name[i] == '/')
-            disk_name[i] = '-';
-      }
-    }
-
-    blocksize = BLOCKSIZE(statbuf);
-
-/*
- * Sanity-check for the values in the struct
- */
-/* Check for negative "available" byes. For example UFS can
- * report negative free space for user. Notice. blk_reserved
- * will start to diminish after this. */
-#if HAVE_STATVFS
-    /* Cast and temporary variable are needed to avoid
-     * compiler warnings.
-     * ((struct statvfs).f_bavail is unsigned (POSIX)) */
-    int64_t signed_bavail = (int64_t)statbuf.f_bavail;
-    if (signed_bavail < 0)
-      statbuf.f_bavail = 0;
-#elif HAVE_STATFS
-    if (statbuf.f_bavail < 0)
-      statbuf.f_bavail = 0;
-#endif
-    /* Make sure that f_blocks >= f_bfree >= f_bavail */
-    if (statbuf.f_bfree < statbuf.f_bavail)
-      statbuf.f_bfree = statbuf.f_bavail;
-    if (statbuf.f_blocks < statbuf.f_bfree)
-      statbuf.f_blocks = statbuf.f_bfree;
-
-    blk_free = (uint64_t)statbuf.f_bavail;
-    blk_reserved = (uint64_t)(statbuf.f_bfree - statbuf.f_bavail);
-    blk_used = (uint64_t)(statbuf.f_blocks - statbuf.f_bfree);
-
-    if (values_absolute) {
-      df_submit_one(disk_name, "df_complex", "free",
-                    (gauge_t)(blk_free * blocksize));
-      df_submit_one(disk_name, "df_complex", "reserved",
-                    (gauge_t)(blk_reserved * blocksize));
-      df_submit_one(disk_name, "df_complex", "used",
-                    (gauge_t)(blk_used * blocksize));
+    if (df_submit_fs(mnt_ptr, dev, &targets[i].buf) != 0) {
+      retval = -1;
+      break;
     }
+  }
 
-    if (values_percentage) {
-      if (statbuf.f_blocks > 0) {
-        df_submit_one(disk_name, "percent_bytes", "free",
-                      (gauge_t)((float_t)(blk_free) / statbuf.f_blocks * 100));
-        df_submit_one(
-            disk_name, "percent_bytes", "reserved",
-            (gauge_t)((float_t)(blk_reserved) / statbuf.f_blocks * 100));
-        df_submit_one(disk_name, "percent_bytes", "used",
-                      (gauge_t)((float_t)(blk_used) / statbuf.f_blocks * 100));
-      } else {
-        retval = -1;
-        break;
-      }
-    }
+  sfree(targets);
+  return retval;
+} /* int df_read */
 
-    /* inode handling */
-    if (report_inodes && statbuf.f_files != 0 && statbuf.f_ffree != 0) {
-      uint64_t inode_free;
-      uint64_t inode_reserved;
-      uint64_t inode_used;
-
-      /* Sanity-check for the values in the struct */
-      if (statbuf.f_ffree < statbuf.f_favail)
-        statbuf.f_ffree = statbuf.f_favail;
-      if (statbuf.f_files < statbuf.f_ffree)
-        statbuf.f_files = statbuf.f_ffree;
-
-      inode_free = (uint64_t)statbuf.f_favail;
-      inode_reserved = (uint64_t)(statbuf.f_ffree - statbuf.f_favail);
-      inode_used = (uint64_t)(statbuf.f_files - statbuf.f_ffree);
-
-      if (values_percentage) {
-        if (statbuf.f_files > 0) {
-          df_submit_one(
-              disk_name, "percent_inodes", "free",
-              (gauge_t)((float_t)(inode_free) / statbuf.f_files * 100));
-          df_submit_one(
-              disk_name, "percent_inodes", "reserved",
-              (gauge_t)((float_t)(inode_reserved) / statbuf.f_files * 100));
-          df_submit_one(
-              disk_name, "percent_inodes", "used",
-              (gauge_t)((float_t)(inode_used) / statbuf.f_files * 100));
-        } else {
-          retval = -1;
-          break;
-        }
-      }
-      if (values_absolute) {
-        df_submit_one(disk_name, "df_inodes", "free", (gauge_t)inode_free);
-        df_submit_one(disk_name, "df_inodes", "reserved",
-                      (gauge_t)inode_reserved);
-        df_submit_one(disk_name, "df_inodes", "used", (gauge_t)inode_used);
-      }
-    }
+static int df_shutdown(void) {
+  pthread_mutex_lock(&df_lock);
+  df_stopping = true;
+  pthread_cond_broadcast(&df_work_cond);
+
+  /* Workers stuck in STATANYFS() cannot be cancelled; give them a moment and
+   * leave the shared state alone if they do not return. */
+  struct timespec deadline =
+      CDTIME_T_TO_TIMESPEC(cdtime() + TIME_T_TO_CDTIME_T(1));
+  while (df_workers > 0) {
+    if (pthread_cond_timedwait(&df_done_cond, &df_lock, &deadline) ==
+        ETIMEDOUT)
+      break;
   }
 
-  cu_mount_freelist(mnt_list);
+  if (df_workers > 0) {
+    NOTICE("df plugin: %d " STATANYFS_STR "() call(s) still blocked at "
+           "shutdown.",
+           df_workers);
+  } else if (df_stats != NULL) {
+    char *key;
+    df_stat_t *st;
+    while (c_avl_pick(df_stats, (void *)&key, (void *)&st) == 0)
+      df_stat_free(st);
+    c_avl_destroy(df_stats);
+    df_stats = NULL;
+    df_queue_head = df_queue_tail = NULL;
+  }
+  pthread_mutex_unlock(&df_lock);
+
+  cu_mount_freelist(df_mounts);
+  df_mounts = NULL;
+#if KERNEL_LINUX
+  if (df_mountinfo_fd >= 0) {
+    close(df_mountinfo_fd);
+    df_mountinfo_fd = -1;
+  }
+#endif
 
-  return retval;
-} /* int df_read */
+  return 0;
+} /* int df_shutdown */
 
 void module_register(void) {
   plugin_register_config("df", df_config, config_keys, config_keys_num);
   plugin_register_init("df", df_init);
   plugin_register_read("df", df_read);
+  plugin_register_shutdown("df", df_shutdown);
 } /* void module_register */
@@ -83,8 +83,22 @@ static bool use_bsd_name;
 /* #endif HAVE_IOKIT_IOKITLIB_H */
 
 #elif KERNEL_LINUX
+#include "utils/avltree/avltree.h"
+
+#ifndef DISKSTATS_FILE
+#define DISKSTATS_FILE "/proc/diskstats"
+#endif
+
 typedef struct diskstats {
   char *name;
+  /* major:minor, used as the key of disktree */
+  uint64_t dev;
+
+  /* Name the device is reported as, either "name" or the value of the
+   * UdevNameAttr property. Resolved once per device, together with
+   * "ignored". */
+  char *output_name;
+  bool ignored;
 
   /* This overflows in roughly 1361 years */
   unsigned int poll_count;
@@ -111,6 +125,12 @@ typedef struct diskstats {
 } diskstats_t;
 
 static diskstats_t *disklist;
+static c_avl_tree_t *disktree;
+
+/* /proc/diskstats is kept open and read with pread(2) from offset zero. */
+static int diskstats_fd = -1;
+static char *diskstats_buf;
+static size_t diskstats_buf_size;
 /* #endif KERNEL_LINUX */
 #elif KERNEL_FREEBSD
 static struct gmesh geom_tree;
@@ -156,6 +176,27 @@ static char *conf_udev_name_attr;
 static struct udev *handle_udev;
 #endif
 
+#if KERNEL_LINUX
+static int disk_compare_dev(const void *a, const void *b) {
+  uint64_t dev_a = *(const uint64_t *)a;
+  uint64_t dev_b = *(const uint64_t *)b;
+
+  if (dev_a < dev_b)
+    return -1;
+  return (dev_a > dev_b) ? 1 : 0;
+} /* int disk_compare_dev */
+
+static void disk_free(diskstats_t *ds) {
+  if (ds == NULL)
+    return;
+
+  if (ds->output_name != ds->name)
+    free(ds->output_name);
+  free(ds->name);
+  free(ds);
+} /* void disk_free */
+#endif /* KERNEL_LINUX */
+
 static const char *config_keys[] = {"Disk", "UseBSDName", "IgnoreSelected",
                                     "UdevNameAttr"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
@@ -219,6 +260,14 @@ static int disk_init(void) {
     /* #endif HAVE_IOKIT_IOKITLIB_H */
 
 #elif KERNEL_LINUX
+  if (disktree == NULL) {
+    disktree = c_avl_create(disk_compare_dev);
+    if (disktree == NULL) {
+      ERROR("disk plugin: c_avl_create failed.");
+      return -1;
+    }
+  }
+
 #if HAVE_LIBUDEV_H
   if (conf_udev_name_attr != NULL) {
     handle_udev = udev_new();
@@ -294,6 +343,21 @@ static int disk_init(void) {
 
 static int disk_shutdown(void) {
 #if KERNEL_LINUX
+  if (diskstats_fd >= 0) {
+    close(diskstats_fd);
+    diskstats_fd = -1;
+  }
+  sfree(diskstats_buf);
+  diskstats_buf_size = 0;
+
+  c_avl_destroy(disktree);
+  disktree = NULL;
+  while (disklist != NULL) {
+    diskstats_t *next = disklist->next;
+    disk_free(disklist);
+    disklist = next;
+  }
+
 #if HAVE_LIBUDEV_H
   if (handle_udev != NULL)
     udev_unref(handle_udev);
@@ -390,6 +454,122 @@ static char *disk_udev_attr_name(struct udev *udev, char *disk_name,
 }
 #endif
 
+#if KERNEL_LINUX
+/* Resolves the name a device is reported as and whether it is ignored. This
+ * is done once per device, since neither changes while the device exists. */
+static void disk_resolve_name(diskstats_t *ds) {
+  ds->output_name = ds->name;
+
+#if HAVE_LIBUDEV_H
+  if (conf_udev_name_attr != NULL) {
+    char *alt_name =
+        disk_udev_attr_name(handle_udev, ds->name, conf_udev_name_attr);
+    if (alt_name != NULL)
+      ds->output_name = alt_name;
+  }
+#endif
+
+  ds->ignored = (ignorelist_match(ignorelist, ds->output_name) != 0);
+} /* void disk_resolve_name */
+
+/* Reads all of DISKSTATS_FILE into diskstats_buf, growing the buffer as
+ * needed, and returns the number of bytes read or -1 on failure. */
+static ssize_t disk_read_diskstats(void) {
+  if (diskstats_fd < 0) {
+    diskstats_fd = open(DISKSTATS_FILE, O_RDONLY);
+    if (diskstats_fd < 0) {
+      ERROR("disk plugin: open(\"" DISKSTATS_FILE "\"): %s", STRERRNO);
+      return -1;
+    }
+  }
+
+  size_t len = 0;
+  while (true) {
+    if (len + 1 >= diskstats_buf_size) {
+      size_t new_size = (diskstats_buf_size == 0) ? 4096
+                                                   : 2 * diskstats_buf_size;
+      char *tmp = realloc(diskstats_buf, new_size);
+      if (tmp == NULL) {
+        ERROR("disk plugin: realloc failed.");
+        return -1;
+      }
+      diskstats_buf = tmp;
+      diskstats_buf_size = new_size;
+    }
+
+    ssize_t status = pread(diskstats_fd, diskstats_buf + len,
+                           diskstats_buf_size - len - 1, (off_t)len);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      ERROR("disk plugin: pread(\"" DISKSTATS_FILE "\"): %s", STRERRNO);
+      close(diskstats_fd);
+      diskstats_fd = -1;
+      return -1;
+    }
+    if (status == 0)
+      break;
+    len += (size_t)status;
+  }
+
+  diskstats_buf[len] = 0;
+  return (ssize_t)len;
+} /* ssize_t disk_read_diskstats */
+
+/* Parses the decimal number at "*ptr", skipping leading blanks, and moves
+ * "*ptr" past it. Returns -1 if no number is left on the line. */
+static int disk_parse_uint(char **ptr, uint64_t *ret_value) {
+  char *p = *ptr;
+
+  while ((*p == ' ') || (*p == '\t'))
+    p++;
+  if ((*p < '0') || (*p > '9')) {
+    *ptr = p;
+    return -1;
+  }
+
+  uint64_t value = 0;
+  while ((*p >= '0') && (*p <= '9')) {
+    value = 10 * value + (uint64_t)(*p - '0');
+    p++;
+  }
+
+  *ptr = p;
+  *ret_value = value;
+  return 0;
+} /* int disk_parse_uint */
+
+/* Splits a line of DISKSTATS_FILE into the device number, the device name
+ * and up to "values_num" counters. Returns the number of counters or -1 if
+ * the line is malformed. "line" is modified. */
+static int disk_parse_line(char *line, uint64_t *ret_dev, char **ret_name,
+                           uint64_t *values, size_t values_num) {
+  uint64_t major, minor;
+
+  if ((disk_parse_uint(&line, &major) != 0) ||
+      (disk_parse_uint(&line, &minor) != 0))
+    return -1;
+
+  while ((*line == ' ') || (*line == '\t'))
+    line++;
+  char *name = line;
+  while ((*line != 0) && (*line != ' ') && (*line != '\t'))
+    line++;
+  if (line == name)
+    return -1;
+  if (*line != 0)
+    *(line++) = 0;
+
+  size_t num = 0;
+  while ((num < values_num) && (disk_parse_uint(&line, &values[num]) == 0))
+    num++;
+
+  *ret_dev = (major << 32) | minor;
+  *ret_name = name;
+  return (int)num;
+} /* int disk_parse_line */
+#endif /* KERNEL_LINUX */
+
 #if HAVE_IOKIT_IOKITLIB_H
 static signed long long dict_get_value(CFDictionaryRef dict, const char *key) {
   signed long long val_int;
@@ -694,10 +874,7 @@ static int disk_read(void) {
   geom_stats_snapshot_free(snap);
 
 #elif KERNEL_LINUX
-  FILE *fh;
-  char buffer[1024];
-
-  char *fields[32];
+  uint64_t values[17];
   static unsigned int poll_count = 0;
 
   derive_t read_sectors = 0;
@@ -716,25 +893,38 @@ static int disk_read(void) {
 
   diskstats_t *ds, *pre_ds;
 
-  if ((fh = fopen("/proc/diskstats", "r")) == NULL) {
-    ERROR("disk plugin: fopen(\"/proc/diskstats\"): %s", STRERRNO);
+  if (disk_read_diskstats() < 0)
     return -1;
-  }
 
   poll_count++;
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
-    int numfields = strsplit(buffer, fields, 32);
+  char *next_line = diskstats_buf;
+  while (*next_line != 0) {
+    char *line = next_line;
+    char *eol = strchr(line, '\n');
+    if (eol != NULL) {
+      *eol = 0;
+      next_line = eol + 1;
+    } else {
+      next_line = line + strlen(line);
+    }
 
-    /* need either 7 fields (partition) or at least 14 fields */
-    if ((numfields != 7) && (numfields < 14))
-      continue;
+    uint64_t dev;
+    char *disk_name;
+    int numvalues = disk_parse_line(line, &dev, &disk_name, values,
+                                    STATIC_ARRAY_SIZE(values));
 
-    char *disk_name = fields[2];
+    /* need either 4 counters (partition) or at least 11 counters */
+    if ((numvalues != 4) && (numvalues < 11))
+      continue;
 
-    for (ds = disklist, pre_ds = disklist; ds != NULL;
-         pre_ds = ds, ds = ds->next)
-      if (strcmp(disk_name, ds->name) == 0)
-        break;
+    ds = NULL;
+    if (c_avl_get(disktree, &dev, (void *)&ds) == 0 &&
+        strcmp(disk_name, ds->name) != 0) {
+      /* The device number has been reused for another device. */
+      DEBUG("disk plugin: Disk %s replaced by %s.", ds->name, disk_name);
+      c_avl_remove(disktree, &dev, NULL, NULL);
+      ds = NULL;
+    }
 
     if (ds == NULL) {
       if ((ds = calloc(1, sizeof(*ds))) == NULL)
@@ -744,38 +934,41 @@ static int disk_read(void) {
         free(ds);
         continue;
       }
+      ds->dev = dev;
 
-      if (pre_ds == NULL)
-        disklist = ds;
-      else
-        pre_ds->next = ds;
+      if (c_avl_insert(disktree, &ds->dev, ds) != 0) {
+        disk_free(ds);
+        continue;
+      }
+      ds->next = disklist;
+      disklist = ds;
     }
 
     is_disk = 0;
-    if (numfields == 7) {
+    if (numvalues == 4) {
       /* Kernel 2.6, Partition */
-      read_ops = atoll(fields[3]);
-      read_sectors = atoll(fields[4]);
-      write_ops = atoll(fields[5]);
-      write_sectors = atoll(fields[6]);
+      read_ops = (derive_t)values[0];
+      read_sectors = (derive_t)values[1];
+      write_ops = (derive_t)values[2];
+      write_sectors = (derive_t)values[3];
     } else {
-      assert(numfields >= 14);
-      read_ops = atoll(fields[3]);
-      write_ops = atoll(fields[7]);
+      assert(numvalues >= 11);
+      read_ops = (derive_t)values[0];
+      write_ops = (derive_t)values[4];
 
-      read_sectors = atoll(fields[5]);
-      write_sectors = atoll(fields[9]);
+      read_sectors = (derive_t)values[2];
+      write_sectors = (derive_t)values[6];
 
       is_disk = 1;
-      read_merged = atoll(fields[4]);
-      read_time = atoll(fields[6]);
-      write_merged = atoll(fields[8]);
-      write_time = atoll(fields[10]);
+      read_merged = (derive_t)values[1];
+      read_time = (derive_t)values[3];
+      write_merged = (derive_t)values[5];
+      write_time = (derive_t)values[7];
 
-      in_progress = atof(fields[11]);
+      in_progress = (gauge_t)values[8];
 
-      io_time = atof(fields[12]);
-      weighted_time = atof(fields[13]);
+      io_time = (derive_t)values[9];
+      weighted_time = (derive_t)values[10];
     }
 
     {
@@ -864,25 +1057,12 @@ static int disk_read(void) {
       continue;
     }
 
-    char *output_name = disk_name;
-
-#if HAVE_LIBUDEV_H
-    char *alt_name = NULL;
-    if (conf_udev_name_attr != NULL) {
-      alt_name =
-          disk_udev_attr_name(handle_udev, disk_name, conf_udev_name_attr);
-      if (alt_name != NULL)
-        output_name = alt_name;
-    }
-#endif
-
-    if (ignorelist_match(ignorelist, output_name) != 0) {
-#if HAVE_LIBUDEV_H
-      /* release udev-based alternate name, if allocated */
-      sfree(alt_name);
-#endif
+    if (ds->output_name == NULL)
+      disk_resolve_name(ds);
+    if (ds->ignored)
       continue;
-    }
+
+    char const *output_name = ds->output_name;
 
     if ((ds->read_bytes != 0) || (ds->write_bytes != 0))
       disk_submit(output_name, "disk_octets", ds->read_bytes, ds->write_bytes);
@@ -902,12 +1082,7 @@ static int disk_read(void) {
       if (ds->has_io_time)
         submit_io_time(output_name, io_time, weighted_time);
     } /* if (is_disk) */
-
-#if HAVE_LIBUDEV_H
-    /* release udev-based alternate name, if allocated */
-    sfree(alt_name);
-#endif
-  } /* while (fgets (buffer, sizeof (buffer), fh) != NULL) */
+  } /* while (*next_line != 0) */
 
   /* Remove disks that have disappeared from diskstats */
   for (ds = disklist, pre_ds = disklist; ds != NULL;) {
@@ -927,11 +1102,14 @@ static int disk_read(void) {
     }
     ds = ds->next;
 
+    diskstats_t *indexed_ds = NULL;
+    if ((c_avl_get(disktree, &missing_ds->dev, (void *)&indexed_ds) == 0) &&
+        (indexed_ds == missing_ds))
+      c_avl_remove(disktree, &missing_ds->dev, NULL, NULL);
+
     DEBUG("disk plugin: Disk %s disappeared.", missing_ds->name);
-    free(missing_ds->name);
-    free(missing_ds);
+    disk_free(missing_ds);
   }
-  fclose(fh);
   /* #endif defined(KERNEL_LINUX) */
 
 #elif HAVE_LIBKSTAT
@@ -38,6 +38,24 @@
 #include <sys/capability.h>
 #endif
 
+#if KERNEL_LINUX
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#if defined(TPACKET3_HDRLEN) && defined(PACKET_FANOUT_HASH)
+#define DNS_HAVE_AF_PACKET 1
+#endif
+#endif
+
+#ifndef DNS_HAVE_AF_PACKET
+#define DNS_HAVE_AF_PACKET 0
+#endif
+
 /*
  * Private data types
  */
@@ -48,30 +66,68 @@ struct counter_list_s {
 };
 typedef struct counter_list_s counter_list_t;
 
+/* Counters of one capture thread. The read callback merges the counters of
+ * all threads, so that capture threads only ever contend with it. */
+struct dns_counters_s {
+  pthread_mutex_t lock;
+  derive_t tr_queries;
+  derive_t tr_responses;
+  counter_list_t *qtype_list;
+  counter_list_t *opcode_list;
+  counter_list_t *rcode_list;
+};
+typedef struct dns_counters_s dns_counters_t;
+
+typedef enum {
+  DNS_CAPTURE_PCAP,
+  DNS_CAPTURE_AF_PACKET,
+} dns_capture_method_t;
+
 /*
  * Private variables
  */
-static const char *config_keys[] = {"Interface", "IgnoreSource",
-                                    "SelectNumericQueryTypes"};
+static const char *config_keys[] = {
+    "Interface",     "IgnoreSource",   "SelectNumericQueryTypes",
+    "CaptureMethod", "CaptureThreads", "BufferSize"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 static int select_numeric_qtype = 1;
 
 #define PCAP_SNAPLEN 1460
 static char *pcap_device;
 
-static derive_t tr_queries;
-static derive_t tr_responses;
-static counter_list_t *qtype_list;
-static counter_list_t *opcode_list;
-static counter_list_t *rcode_list;
+static dns_capture_method_t capture_method = DNS_CAPTURE_PCAP;
+static size_t capture_threads_num = 1;
+/* Size of each capture thread's packet ring. */
+static size_t buffer_size = 4 * 1024 * 1024;
+
+static dns_counters_t *counters;
+static size_t counters_num;
+static __thread dns_counters_t *thread_counters;
 
 static pthread_t listen_thread;
 static int listen_thread_init;
-/* The `traffic' mutex if for `tr_queries' and `tr_responses' */
-static pthread_mutex_t traffic_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t qtype_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t opcode_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t rcode_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+#if DNS_HAVE_AF_PACKET
+#define DNS_RING_BLOCK_SIZE (1 << 20)
+#define DNS_RING_FRAME_SIZE 2048
+/* Blocks are handed to user space once they are full or after this many
+ * milliseconds, whichever comes first. */
+#define DNS_RING_TIMEOUT_MS 100
+
+typedef struct {
+  int fd;
+  uint8_t *ring;
+  size_t ring_size;
+  size_t blocks_num;
+  dns_counters_t *counters;
+  pthread_t thread;
+  bool thread_running;
+} dns_capture_t;
+
+static dns_capture_t *captures;
+static size_t captures_num;
+static bool captures_stop;
+#endif /* DNS_HAVE_AF_PACKET */
 
 /*
  * Private functions
@@ -127,6 +183,20 @@ static void counter_list_add(counter_list_t **list, unsigned int key,
   }
 }
 
+static void counter_list_free(counter_list_t *list) {
+  while (list != NULL) {
+    counter_list_t *next = list->next;
+    free(list);
+    list = next;
+  }
+}
+
+static void counter_list_merge(counter_list_t **dst,
+                               counter_list_t const *src) {
+  for (counter_list_t const *entry = src; entry != NULL; entry = entry->next)
+    counter_list_add(dst, entry->key, entry->value);
+}
+
 static int dns_config(const char *key, const char *value) {
   if (strcasecmp(key, "Interface") == 0) {
     if (pcap_device != NULL)
@@ -141,6 +211,35 @@ static int dns_config(const char *key, const char *value) {
       select_numeric_qtype = 0;
     else
       select_numeric_qtype = 1;
+  } else if (strcasecmp(key, "CaptureMethod") == 0) {
+    if (strcasecmp(value, "libpcap") == 0) {
+      capture_method = DNS_CAPTURE_PCAP;
+    } else if (strcasecmp(value, "AF_PACKET") == 0) {
+#if DNS_HAVE_AF_PACKET
+      capture_method = DNS_CAPTURE_AF_PACKET;
+#else
+      ERROR("dns plugin: CaptureMethod \"AF_PACKET\" is not supported on "
+            "this system.");
+      return 1;
+#endif
+    } else {
+      ERROR("dns plugin: Unknown CaptureMethod \"%s\".", value);
+      return 1;
+    }
+  } else if (strcasecmp(key, "CaptureThreads") == 0) {
+    int tmp = atoi(value);
+    if (tmp < 1) {
+      ERROR("dns plugin: CaptureThreads must be a positive number.");
+      return 1;
+    }
+    capture_threads_num = (size_t)tmp;
+  } else if (strcasecmp(key, "BufferSize") == 0) {
+    double tmp = atof(value);
+    if (tmp < 1.0) {
+      ERROR("dns plugin: BufferSize must be at least one megabyte.");
+      return 1;
+    }
+    buffer_size = (size_t)(tmp * 1024.0 * 1024.0);
   } else {
     return -1;
   }
@@ -149,6 +248,13 @@ static int dns_config(const char *key, const char *value) {
 }
 
 static void dns_child_callback(const rfc1035_header_t *dns) {
+  dns_counters_t *c = thread_counters;
+
+  if (c == NULL)
+    return;
+
+  pthread_mutex_lock(&c->lock);
+
   if (dns->qr == 0) {
     /* This is a query */
     int skip = 0;
@@ -158,30 +264,21 @@ static void dns_child_callback(const rfc1035_header_t *dns) {
         skip = 1;
     }
 
-    pthread_mutex_lock(&traffic_mutex);
-    tr_queries += dns->length;
-    pthread_mutex_unlock(&traffic_mutex);
+    c->tr_queries += dns->length;
 
-    if (skip == 0) {
-      pthread_mutex_lock(&qtype_mutex);
-      counter_list_add(&qtype_list, dns->qtype, 1);
-      pthread_mutex_unlock(&qtype_mutex);
-    }
+    if (skip == 0)
+      counter_list_add(&c->qtype_list, dns->qtype, 1);
   } else {
     /* This is a reply */
-    pthread_mutex_lock(&traffic_mutex);
-    tr_responses += dns->length;
-    pthread_mutex_unlock(&traffic_mutex);
+    c->tr_responses += dns->length;
 
-    pthread_mutex_lock(&rcode_mutex);
-    counter_list_add(&rcode_list, dns->rcode, 1);
-    pthread_mutex_unlock(&rcode_mutex);
+    counter_list_add(&c->rcode_list, dns->rcode, 1);
   }
 
   /* FIXME: Are queries, replies or both interesting? */
-  pthread_mutex_lock(&opcode_mutex);
-  counter_list_add(&opcode_list, dns->opcode, 1);
-  pthread_mutex_unlock(&opcode_mutex);
+  counter_list_add(&c->opcode_list, dns->opcode, 1);
+
+  pthread_mutex_unlock(&c->lock);
 }
 
 static int dns_run_pcap_loop(void) {
@@ -257,6 +354,8 @@ static void *dns_child_loop(__attribute__((unused)) void *dummy) /* {{{ */
 {
   int status;
 
+  thread_counters = &counters[0];
+
   while (42) {
     status = dns_run_pcap_loop();
     if (status != PCAP_ERROR_IFACE_NOT_UP)
@@ -272,26 +371,300 @@ static void *dns_child_loop(__attribute__((unused)) void *dummy) /* {{{ */
   return NULL;
 } /* }}} void *dns_child_loop */
 
+
+#if DNS_HAVE_AF_PACKET
+/* The equivalent of "udp port 53" for SOCK_DGRAM sockets, which pass the
+ * network layer header to the filter. Non-first IPv4 fragments are dropped.
+ * Accepted packets are truncated to PCAP_SNAPLEN, like the libpcap backend
+ * does. */
+static struct sock_filter dns_bpf_code[] = {
+    /* 0 */ BPF_STMT(BPF_LD | BPF_H | BPF_ABS, SKF_AD_OFF + SKF_AD_PROTOCOL),
+    /* 1 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 0, 9),
+    /* 2 */ BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 9),
+    /* 3 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 15),
+    /* 4 */ BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 6),
+    /* 5 */ BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, 13, 0),
+    /* 6 */ BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),
+    /* 7 */ BPF_STMT(BPF_LD | BPF_H | BPF_IND, 0),
+    /* 8 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 53, 9, 0),
+    /* 9 */ BPF_STMT(BPF_LD | BPF_H | BPF_IND, 2),
+    /* 10 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 53, 7, 8),
+    /* 11 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IPV6, 0, 7),
+    /* 12 */ BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 6),
+    /* 13 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 5),
+    /* 14 */ BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 40),
+    /* 15 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 53, 2, 0),
+    /* 16 */ BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 42),
+    /* 17 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 53, 0, 1),
+    /* 18 */ BPF_STMT(BPF_RET | BPF_K, PCAP_SNAPLEN),
+    /* 19 */ BPF_STMT(BPF_RET | BPF_K, 0),
+};
+
+static void dns_capture_close(dns_capture_t *cap) /* {{{ */
+{
+  if (cap->ring != NULL)
+    munmap(cap->ring, cap->ring_size);
+  cap->ring = NULL;
+
+  if (cap->fd >= 0)
+    close(cap->fd);
+  cap->fd = -1;
+} /* }}} void dns_capture_close */
+
+/* Opens an AF_PACKET socket with a TPACKET_V3 receive ring of `buffer_size'
+ * bytes. With several capture threads, all sockets join one fanout group and
+ * the kernel hashes flows onto them. */
+static int dns_capture_open(dns_capture_t *cap, int fanout_id) /* {{{ */
+{
+  char const *device = (pcap_device != NULL) ? pcap_device : "any";
+  unsigned int ifindex = 0;
+
+  if ((pcap_device != NULL) && (strcmp(pcap_device, "any") != 0)) {
+    ifindex = if_nametoindex(pcap_device);
+    if (ifindex == 0) {
+      ERROR("dns plugin: Unknown interface `%s': %s", device, STRERRNO);
+      return -1;
+    }
+  }
+
+  cap->fd = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_ALL));
+  if (cap->fd < 0) {
+    ERROR("dns plugin: Creating an AF_PACKET socket failed: %s", STRERRNO);
+    return -1;
+  }
+
+  int version = TPACKET_V3;
+  if (setsockopt(cap->fd, SOL_PACKET, PACKET_VERSION, &version,
+                 sizeof(version)) != 0) {
+    ERROR("dns plugin: Enabling TPACKET_V3 failed: %s", STRERRNO);
+    dns_capture_close(cap);
+    return -1;
+  }
+
+  struct sock_fprog fprog = {
+      .len = STATIC_ARRAY_SIZE(dns_bpf_code),
+      .filter = dns_bpf_code,
+  };
+  if (setsockopt(cap->fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog,
+                 sizeof(fprog)) != 0) {
+    ERROR("dns plugin: Attaching the packet filter failed: %s", STRERRNO);
+    dns_capture_close(cap);
+    return -1;
+  }
+
+  cap->blocks_num = buffer_size / DNS_RING_BLOCK_SIZE;
+  if (cap->blocks_num < 2)
+    cap->blocks_num = 2;
+
+  struct tpacket_req3 req = {
+      .tp_block_size = DNS_RING_BLOCK_SIZE,
+      .tp_block_nr = (unsigned int)cap->blocks_num,
+      .tp_frame_size = DNS_RING_FRAME_SIZE,
+      .tp_frame_nr = (unsigned int)(cap->blocks_num * DNS_RING_BLOCK_SIZE /
+                                    DNS_RING_FRAME_SIZE),
+      .tp_retire_blk_tov = DNS_RING_TIMEOUT_MS,
+  };
+  if (setsockopt(cap->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) !=
+      0) {
+    ERROR("dns plugin: Setting up a %zu byte packet ring failed: %s",
+          cap->blocks_num * DNS_RING_BLOCK_SIZE, STRERRNO);
+    dns_capture_close(cap);
+    return -1;
+  }
+
+  cap->ring_size = cap->blocks_num * DNS_RING_BLOCK_SIZE;
+  cap->ring = mmap(NULL, cap->ring_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_LOCKED, cap->fd, 0);
+  if (cap->ring == MAP_FAILED) {
+    /* MAP_LOCKED fails without CAP_IPC_LOCK once RLIMIT_MEMLOCK is
+     * exceeded. The ring is usable without it. */
+    cap->ring =
+        mmap(NULL, cap->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+             cap->fd, 0);
+  }
+  if (cap->ring == MAP_FAILED) {
+    ERROR("dns plugin: Mapping the packet ring failed: %s", STRERRNO);
+    cap->ring = NULL;
+    dns_capture_close(cap);
+    return -1;
+  }
+
+  struct sockaddr_ll sll = {
+      .sll_family = AF_PACKET,
+      .sll_protocol = htons(ETH_P_ALL),
+      .sll_ifindex = (int)ifindex,
+  };
+  if (bind(cap->fd, (struct sockaddr *)&sll, sizeof(sll)) != 0) {
+    ERROR("dns plugin: Binding to interface `%s' failed: %s", device,
+          STRERRNO);
+    dns_capture_close(cap);
+    return -1;
+  }
+
+  if (capture_threads_num > 1) {
+    int fanout = fanout_id | (PACKET_FANOUT_HASH << 16);
+    if (setsockopt(cap->fd, SOL_PACKET, PACKET_FANOUT, &fanout,
+                   sizeof(fanout)) != 0) {
+      ERROR("dns plugin: Joining fanout group %d failed: %s", fanout_id,
+            STRERRNO);
+      dns_capture_close(cap);
+      return -1;
+    }
+  }
+
+  return 0;
+} /* }}} int dns_capture_open */
+
+static void dns_capture_block(struct tpacket_block_desc *bd) /* {{{ */
+{
+  uint32_t pkts_num = bd->hdr.bh1.num_pkts;
+  struct tpacket3_hdr *hdr =
+      (struct tpacket3_hdr *)((uint8_t *)bd + bd->hdr.bh1.offset_to_first_pkt);
+
+  for (uint32_t i = 0; i < pkts_num; i++) {
+    struct sockaddr_ll const *sll =
+        (void *)((uint8_t *)hdr + TPACKET_ALIGN(sizeof(*hdr)));
+
+    /* Like libpcap, ignore the outgoing copy of packets on loopback
+     * interfaces, so that they are not counted twice. */
+    if ((sll->sll_pkttype != PACKET_OUTGOING) ||
+        (sll->sll_hatype != ARPHRD_LOOPBACK))
+      handle_ip_packet((u_char *)hdr + hdr->tp_net, (int)hdr->tp_snaplen);
+    hdr = (struct tpacket3_hdr *)((uint8_t *)hdr + hdr->tp_next_offset);
+  }
+} /* }}} void dns_capture_block */
+
+static void *dns_capture_loop(void *arg) /* {{{ */
+{
+  dns_capture_t *cap = arg;
+  size_t block = 0;
+
+  thread_counters = cap->counters;
+
+  while (!__atomic_load_n(&captures_stop, __ATOMIC_ACQUIRE)) {
+    struct tpacket_block_desc *bd =
+        (struct tpacket_block_desc *)(cap->ring + block * DNS_RING_BLOCK_SIZE);
+
+    if ((__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+         TP_STATUS_USER) == 0) {
+      struct pollfd pfd = {.fd = cap->fd, .events = POLLIN | POLLERR};
+      /* Wake up regularly to notice shutdown. */
+      if ((poll(&pfd, 1, 2 * DNS_RING_TIMEOUT_MS) < 0) && (errno != EINTR)) {
+        ERROR("dns plugin: poll failed: %s", STRERRNO);
+        break;
+      }
+      continue;
+    }
+
+    dns_capture_block(bd);
+
+    /* Hand the block back to the kernel. */
+    __atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL,
+                     __ATOMIC_RELEASE);
+    block = (block + 1) % cap->blocks_num;
+  }
+
+  return NULL;
+} /* }}} void *dns_capture_loop */
+
+static int dns_capture_start(void) /* {{{ */
+{
+  int fanout_id = (int)(getpid() & 0xffff);
+
+  captures = calloc(capture_threads_num, sizeof(*captures));
+  if (captures == NULL) {
+    ERROR("dns plugin: calloc failed.");
+    return -1;
+  }
+
+  for (size_t i = 0; i < capture_threads_num; i++) {
+    dns_capture_t *cap = captures + i;
+
+    cap->fd = -1;
+    cap->counters = &counters[i];
+    if (dns_capture_open(cap, fanout_id) != 0)
+      break;
+    captures_num++;
+  }
+
+  if (captures_num != capture_threads_num) {
+    for (size_t i = 0; i < captures_num; i++)
+      dns_capture_close(captures + i);
+    sfree(captures);
+    captures_num = 0;
+    return -1;
+  }
+
+  for (size_t i = 0; i < captures_num; i++) {
+    dns_capture_t *cap = captures + i;
+    int status = plugin_thread_create(&cap->thread, dns_capture_loop, cap,
+                                      "dns capture");
+    if (status != 0) {
+      ERROR("dns plugin: pthread_create failed: %s", STRERROR(status));
+      continue;
+    }
+    cap->thread_running = true;
+  }
+
+  INFO("dns plugin: Capturing on `%s' with %zu AF_PACKET socket(s).",
+       (pcap_device != NULL) ? pcap_device : "any", captures_num);
+  return 0;
+} /* }}} int dns_capture_start */
+
+static int dns_shutdown(void) /* {{{ */
+{
+  __atomic_store_n(&captures_stop, true, __ATOMIC_RELEASE);
+
+  for (size_t i = 0; i < captures_num; i++) {
+    if (captures[i].thread_running)
+      pthread_join(captures[i].thread, NULL);
+    dns_capture_close(captures + i);
+  }
+  sfree(captures);
+  captures_num = 0;
+
+  return 0;
+} /* }}} int dns_shutdown */
+#endif /* DNS_HAVE_AF_PACKET */
+
 static int dns_init(void) {
   /* clean up an old thread */
   int status;
 
-  pthread_mutex_lock(&traffic_mutex);
-  tr_queries = 0;
-  tr_responses = 0;
-  pthread_mutex_unlock(&traffic_mutex);
-
   if (listen_thread_init != 0)
     return -1;
 
-  status = plugin_thread_create(&listen_thread, dns_child_loop, (void *)0,
-                                "dns listen");
-  if (status != 0) {
-    ERROR("dns plugin: pthread_create failed: %s", STRERRNO);
-    return -1;
+  if (counters == NULL) {
+    counters_num =
+        (capture_method == DNS_CAPTURE_PCAP) ? 1 : capture_threads_num;
+    counters = calloc(counters_num, sizeof(*counters));
+    if (counters == NULL) {
+      ERROR("dns plugin: calloc failed.");
+      return -1;
+    }
+    for (size_t i = 0; i < counters_num; i++)
+      pthread_mutex_init(&counters[i].lock, NULL);
   }
 
-  listen_thread_init = 1;
+  dnstop_set_callback(dns_child_callback);
+
+#if DNS_HAVE_AF_PACKET
+  if (capture_method == DNS_CAPTURE_AF_PACKET) {
+    if (dns_capture_start() != 0)
+      return -1;
+    listen_thread_init = 1;
+  } else
+#endif
+  {
+    status = plugin_thread_create(&listen_thread, dns_child_loop, (void *)0,
+                                  "dns listen");
+    if (status != 0) {
+      ERROR("dns plugin: pthread_create failed: %s", STRERRNO);
+      return -1;
+    }
+
+    listen_thread_init = 1;
+  }
 
 #if defined(HAVE_SYS_CAPABILITY_H) && defined(CAP_NET_RAW)
   if (check_capability(CAP_NET_RAW) != 0) {
@@ -338,58 +711,45 @@ static void submit_octets(derive_t queries, derive_t responses) {
 } /* void submit_octets */
 
 static int dns_read(void) {
-  unsigned int keys[T_MAX];
-  unsigned int values[T_MAX];
-  int len;
-
-  counter_list_t *ptr;
-
-  pthread_mutex_lock(&traffic_mutex);
-  values[0] = tr_queries;
-  values[1] = tr_responses;
-  pthread_mutex_unlock(&traffic_mutex);
-
-  if ((values[0] != 0) || (values[1] != 0))
-    submit_octets(values[0], values[1]);
-
-  pthread_mutex_lock(&qtype_mutex);
-  for (ptr = qtype_list, len = 0; (ptr != NULL) && (len < T_MAX);
-       ptr = ptr->next, len++) {
-    keys[len] = ptr->key;
-    values[len] = ptr->value;
+  derive_t queries = 0;
+  derive_t responses = 0;
+  counter_list_t *qtype = NULL;
+  counter_list_t *opcode = NULL;
+  counter_list_t *rcode = NULL;
+
+  for (size_t i = 0; i < counters_num; i++) {
+    dns_counters_t *c = counters + i;
+
+    pthread_mutex_lock(&c->lock);
+    queries += c->tr_queries;
+    responses += c->tr_responses;
+    counter_list_merge(&qtype, c->qtype_list);
+    counter_list_merge(&opcode, c->opcode_list);
+    counter_list_merge(&rcode, c->rcode_list);
+    pthread_mutex_unlock(&c->lock);
   }
-  pthread_mutex_unlock(&qtype_mutex);
 
-  for (int i = 0; i < len; i++) {
-    DEBUG("dns plugin: qtype = %u; counter = %u;", keys[i], values[i]);
-    submit_derive("dns_qtype", qtype_str(keys[i]), values[i]);
-  }
+  if ((queries != 0) || (responses != 0))
+    submit_octets(queries, responses);
 
-  pthread_mutex_lock(&opcode_mutex);
-  for (ptr = opcode_list, len = 0; (ptr != NULL) && (len < T_MAX);
-       ptr = ptr->next, len++) {
-    keys[len] = ptr->key;
-    values[len] = ptr->value;
+  for (counter_list_t *ptr = qtype; ptr != NULL; ptr = ptr->next) {
+    DEBUG("dns plugin: qtype = %u; counter = %u;", ptr->key, ptr->value);
+    submit_derive("dns_qtype", qtype_str(ptr->key), ptr->value);
   }
-  pthread_mutex_unlock(&opcode_mutex);
 
-  for (int i = 0; i < len; i++) {
-    DEBUG("dns plugin: opcode = %u; counter = %u;", keys[i], values[i]);
-    submit_derive("dns_opcode", opcode_str(keys[i]), values[i]);
+  for (counter_list_t *ptr = opcode; ptr != NULL; ptr = ptr->next) {
+    DEBUG("dns plugin: opcode = %u; counter = %u;", ptr->key, ptr->value);
+    submit_derive("dns_opcode", opcode_str(ptr->key), ptr->value);
   }
 
-  pthread_mutex_lock(&rcode_mutex);
-  for (ptr = rcode_list, len = 0; (ptr != NULL) && (len < T_MAX);
-       ptr = ptr->next, len++) {
-    keys[len] = ptr->key;
-    values[len] = ptr->value;
+  for (counter_list_t *ptr = rcode; ptr != NULL; ptr = ptr->next) {
+    DEBUG("dns plugin: rcode = %u; counter = %u;", ptr->key, ptr->value);
+    submit_derive("dns_rcode", rcode_str(ptr->key), ptr->value);
   }
-  pthread_mutex_unlock(&rcode_mutex);
 
-  for (int i = 0; i < len; i++) {
-    DEBUG("dns plugin: rcode = %u; counter = %u;", keys[i], values[i]);
-    submit_derive("dns_rcode", rcode_str(keys[i]), values[i]);
-  }
+  counter_list_free(qtype);
+  counter_list_free(opcode);
+  counter_list_free(rcode);
 
   return 0;
 } /* int dns_read */
@@ -398,4 +758,7 @@ void module_register(void) {
   plugin_register_config("dns", dns_config, config_keys, config_keys_num);
   plugin_register_init("dns", dns_init);
   plugin_register_read("dns", dns_read);
+#if DNS_HAVE_AF_PACKET
+  plugin_register_shutdown("dns", dns_shutdown);
+#endif
 } /* void module_register */
@@ -33,7 +33,6 @@
 #include "utils_time.h"
 
 #include <errno.h>
-#include <jansson.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -42,6 +41,21 @@
 #include <sys/un.h>
 #include <unistd.h>
 
+#include <yajl/yajl_parse.h>
+#if HAVE_YAJL_YAJL_VERSION_H
+#include <yajl/yajl_version.h>
+#endif
+
+#if defined(YAJL_MAJOR) && (YAJL_MAJOR > 1)
+#define HAVE_YAJL_V2 1
+#endif
+
+#if HAVE_YAJL_V2
+typedef size_t yajl_len_t;
+#else
+typedef unsigned int yajl_len_t;
+#endif
+
 #define BUF_SIZE 100000
 #define PLUGIN_NAME "dpdk_telemetry"
 #define DEFAULT_DPDK_PATH "/var/run/dpdk/rte/telemetry"
@@ -93,148 +107,325 @@ static int dpdk_telemetry_config(oconfig_item_t *ci) {
   return 0;
 }
 
-static int dpdk_telemetry_parse(json_t *stats, json_t *port) {
-  json_t *statsArrayObj;
-  int portid;
+/* The reply is parsed with yajl's callback interface as it is scanned, without
+ * building a document tree. Only the "port", "name" and "value" fields are
+ * looked at:
+ *
+ *   {"status_code": "Status OK: 200",
+ *    "data": [{"port": 0,
+ *              "stats": [{"name": "rx_good_packets", "value": 42}, ...]}]}
+ *
+ * Depth counts the open maps and arrays, so the fields above are the keys at
+ * depths 1, 3 and 5. */
+typedef struct {
+  char name[DATA_MAX_NAME_LEN];
+  value_t value;
+} dpdk_telemetry_stat_t;
+
+typedef enum {
+  KEY_OTHER = 0,
+  KEY_DATA,
+  KEY_PORT,
+  KEY_STATS,
+  KEY_NAME,
+  KEY_VALUE,
+} dpdk_telemetry_key_t;
+
+typedef struct {
+  int depth;
+  dpdk_telemetry_key_t key[6];
+  bool have_data;
+  bool in_data;
+  bool in_stats;
+
+  int port;
+  dpdk_telemetry_stat_t stat;
+  bool have_name;
+  bool have_value;
+
+  /* Statistics of the current port. Kept between reads, so the arrays only
+   * grow when a port reports more statistics than ever before. */
+  dpdk_telemetry_stat_t *stats;
+  size_t stats_num;
+  size_t stats_size;
+  value_list_t *vls;
+  size_t vls_size;
+} dpdk_telemetry_parser_t;
+
+static dpdk_telemetry_parser_t parser;
+static char *recv_buffer;
+static size_t recv_buffer_size;
+
+static int dpdk_telemetry_dispatch(dpdk_telemetry_parser_t *p) {
+  if (p->stats_num == 0)
+    return 0;
+
+  if (p->vls_size < p->stats_num) {
+    value_list_t *tmp = realloc(p->vls, p->stats_num * sizeof(*tmp));
+    if (tmp == NULL) {
+      ERROR(PLUGIN_NAME ": realloc failed");
+      return -1;
+    }
+    p->vls = tmp;
+    p->vls_size = p->stats_num;
+  }
 
-  if (!stats) {
-    ERROR(PLUGIN_NAME ": Stats pointer is invalid");
-    return -1;
+  cdtime_t now = cdtime();
+  for (size_t i = 0; i < p->stats_num; i++) {
+    value_list_t *vl = p->vls + i;
+    *vl = (value_list_t){
+        .values = &p->stats[i].value,
+        .values_len = 1,
+        .time = now,
+    };
+    sstrncpy(vl->plugin, "dpdk_telemetry", sizeof(vl->plugin));
+    if (p->port == -1)
+      snprintf(vl->plugin_instance, sizeof(vl->plugin_instance), "%s",
+               p->stats[i].name);
+    else
+      snprintf(vl->plugin_instance, sizeof(vl->plugin_instance), "%s.%d",
+               p->stats[i].name, p->port);
+    sstrncpy(vl->type, "dpdk_telemetry", sizeof(vl->type));
+    sstrncpy(vl->type_instance, p->stats[i].name, sizeof(vl->type_instance));
   }
 
-  if (!port) {
-    ERROR(PLUGIN_NAME ":  Port pointer is invalid");
+  int failed = plugin_dispatch_value_lists(p->vls, p->stats_num);
+  p->stats_num = 0;
+  if (failed != 0) {
+    ERROR(PLUGIN_NAME ": Failed to dispatch values");
     return -1;
   }
-  portid = json_integer_value(port);
+  return 0;
+}
 
-  if (portid < -1) {
-    ERROR(PLUGIN_NAME ": portid is invalid");
-    return -1;
+static int dpdk_telemetry_cb_map_key(void *ctx, const unsigned char *key,
+                                     yajl_len_t len) {
+  dpdk_telemetry_parser_t *p = ctx;
+  dpdk_telemetry_key_t k = KEY_OTHER;
+
+#define KEY_IS(s) ((len == strlen(s)) && (memcmp(key, s, len) == 0))
+  if (p->depth == 1 && KEY_IS("data"))
+    k = KEY_DATA;
+  else if (p->depth == 3 && p->in_data && KEY_IS("port"))
+    k = KEY_PORT;
+  else if (p->depth == 3 && p->in_data && KEY_IS("stats"))
+    k = KEY_STATS;
+  else if (p->depth == 5 && p->in_stats && KEY_IS("name"))
+    k = KEY_NAME;
+  else if (p->depth == 5 && p->in_stats && KEY_IS("value"))
+    k = KEY_VALUE;
+#undef KEY_IS
+
+  if (p->depth < (int)STATIC_ARRAY_SIZE(p->key))
+    p->key[p->depth] = k;
+  return 1;
+}
+
+static dpdk_telemetry_key_t dpdk_telemetry_key(dpdk_telemetry_parser_t *p) {
+  if (p->depth < 1 || p->depth >= (int)STATIC_ARRAY_SIZE(p->key))
+    return KEY_OTHER;
+  return p->key[p->depth];
+}
+
+static int dpdk_telemetry_cb_start_map(void *ctx) {
+  dpdk_telemetry_parser_t *p = ctx;
+
+  p->depth++;
+  if (p->depth < (int)STATIC_ARRAY_SIZE(p->key))
+    p->key[p->depth] = KEY_OTHER;
+
+  if (p->depth == 3 && p->in_data) {
+    p->port = -2;
+    p->stats_num = 0;
+  } else if (p->depth == 5 && p->in_stats) {
+    p->have_name = false;
+    p->have_value = false;
   }
+  return 1;
+}
 
-  json_t *name, *value;
-  const char *name_string;
-  int statslen, i;
-  uint64_t value_int;
-  statslen = json_array_size(stats);
-  for (i = 0; i < statslen; i++) {
-    statsArrayObj = json_array_get(stats, i);
-    name = json_object_get(statsArrayObj, "name");
-    value = json_object_get(statsArrayObj, "value");
-    if (!name) {
-      ERROR(PLUGIN_NAME ": Request does not have name field");
-      return -1;
-    }
-    if (!json_is_string(name)) {
-      ERROR(PLUGIN_NAME ": Metric name is not a string");
-      return -1;
-    }
-    name_string = json_string_value(name);
-    if (!value) {
-      ERROR(PLUGIN_NAME ": Request does not have value name");
-      return -1;
-    }
-    if (!json_is_integer(value)) {
-      ERROR(PLUGIN_NAME ": Metric value is not an integer");
-      return -1;
-    }
+static int dpdk_telemetry_cb_end_map(void *ctx) {
+  dpdk_telemetry_parser_t *p = ctx;
 
-    char dev_name[DATA_MAX_NAME_LEN];
-    if (portid == -1)
-      snprintf(dev_name, sizeof(dev_name), "%s", name_string);
+  if (p->depth == 5 && p->in_stats && p->have_name && p->have_value) {
+    if (p->stats_num == p->stats_size) {
+      size_t size = (p->stats_size == 0) ? 64 : 2 * p->stats_size;
+      dpdk_telemetry_stat_t *tmp = realloc(p->stats, size * sizeof(*tmp));
+      if (tmp == NULL) {
+        ERROR(PLUGIN_NAME ": realloc failed");
+        return 0;
+      }
+      p->stats = tmp;
+      p->stats_size = size;
+    }
+    p->stats[p->stats_num++] = p->stat;
+  } else if (p->depth == 3 && p->in_data) {
+    if (p->port < -1)
+      ERROR(PLUGIN_NAME ": portid is invalid");
     else
-      snprintf(dev_name, sizeof(dev_name), "%s.%d", name_string, portid);
-    value_int = json_integer_value(value);
-    value_t dpdk_telemetry_values[1];
-    value_list_t dpdk_telemetry_vl = VALUE_LIST_INIT;
-    dpdk_telemetry_values[0].counter = value_int;
-    dpdk_telemetry_vl.values = dpdk_telemetry_values;
-    dpdk_telemetry_vl.values_len = 1;
-    dpdk_telemetry_vl.time = cdtime();
-    snprintf(dpdk_telemetry_vl.host, sizeof(dpdk_telemetry_vl.host), "%s",
-             hostname_g);
-    snprintf(dpdk_telemetry_vl.plugin, sizeof(dpdk_telemetry_vl.plugin),
-             "dpdk_telemetry");
-    sstrncpy(dpdk_telemetry_vl.plugin_instance, dev_name,
-             sizeof(dpdk_telemetry_vl.plugin_instance));
-    snprintf(dpdk_telemetry_vl.type, sizeof(dpdk_telemetry_vl.type),
-             "dpdk_telemetry");
-    snprintf(dpdk_telemetry_vl.type_instance,
-             sizeof(dpdk_telemetry_vl.type_instance), "%s", name_string);
-
-    int ret = plugin_dispatch_values(&dpdk_telemetry_vl);
-    if (ret < 0) {
-      ERROR(PLUGIN_NAME ": Failed to dispatch values");
-      return -1;
+      dpdk_telemetry_dispatch(p);
+    p->stats_num = 0;
+  }
+
+  p->depth--;
+  return 1;
+}
+
+static int dpdk_telemetry_cb_start_array(void *ctx) {
+  dpdk_telemetry_parser_t *p = ctx;
+  dpdk_telemetry_key_t k = dpdk_telemetry_key(p);
+
+  p->depth++;
+  if (p->depth == 2 && k == KEY_DATA) {
+    p->have_data = true;
+    p->in_data = true;
+  } else if (p->depth == 4 && p->in_data && k == KEY_STATS) {
+    p->in_stats = true;
+  }
+  return 1;
+}
+
+static int dpdk_telemetry_cb_end_array(void *ctx) {
+  dpdk_telemetry_parser_t *p = ctx;
+
+  if (p->depth == 2)
+    p->in_data = false;
+  else if (p->depth == 4)
+    p->in_stats = false;
+
+  p->depth--;
+  return 1;
+}
+
+static int dpdk_telemetry_cb_string(void *ctx, const unsigned char *val,
+                                    yajl_len_t len) {
+  dpdk_telemetry_parser_t *p = ctx;
+
+  if (p->depth == 5 && p->in_stats && dpdk_telemetry_key(p) == KEY_NAME) {
+    if (len >= sizeof(p->stat.name))
+      len = sizeof(p->stat.name) - 1;
+    memcpy(p->stat.name, val, len);
+    p->stat.name[len] = 0;
+    p->have_name = true;
+  }
+  return 1;
+}
+
+/* Numbers are handled as strings so counters above INT64_MAX survive. */
+static int dpdk_telemetry_cb_number(void *ctx, const char *val,
+                                    yajl_len_t len) {
+  dpdk_telemetry_parser_t *p = ctx;
+  dpdk_telemetry_key_t k = dpdk_telemetry_key(p);
+  char buffer[32];
+
+  if (!(p->depth == 3 && p->in_data && k == KEY_PORT) &&
+      !(p->depth == 5 && p->in_stats && k == KEY_VALUE))
+    return 1;
+
+  if (len >= sizeof(buffer))
+    return 1;
+  memcpy(buffer, val, len);
+  buffer[len] = 0;
+
+  char *endptr = NULL;
+  errno = 0;
+  if (k == KEY_PORT) {
+    long port = strtol(buffer, &endptr, 10);
+    if (errno == 0 && endptr != buffer && *endptr == 0 && port >= INT_MIN &&
+        port <= INT_MAX)
+      p->port = (int)port;
+  } else {
+    unsigned long long value = strtoull(buffer, &endptr, 10);
+    if (errno == 0 && endptr != buffer && *endptr == 0) {
+      p->stat.value.counter = (counter_t)value;
+      p->have_value = true;
     }
   }
-  return 0;
+  return 1;
 }
 
-static int parse_json(char *buf) {
+static yajl_callbacks dpdk_telemetry_callbacks = {
+    .yajl_number = dpdk_telemetry_cb_number,
+    .yajl_string = dpdk_telemetry_cb_string,
+    .yajl_start_map = dpdk_telemetry_cb_start_map,
+    .yajl_map_key = dpdk_telemetry_cb_map_key,
+    .yajl_end_map = dpdk_telemetry_cb_end_map,
+    .yajl_start_array = dpdk_telemetry_cb_start_array,
+    .yajl_end_array = dpdk_telemetry_cb_end_array,
+};
 
+static int parse_json(char *buf, size_t len) {
   if (!buf) {
     ERROR(PLUGIN_NAME ": buf pointer is invalid");
     return -1;
   }
-  json_error_t error;
-  json_t *root = json_loads(buf, 0, &error);
-  int arraylen, i;
-  json_t *status, *dataArray, *stats, *dataArrayObj;
-  stats = NULL;
-
-  if (!root) {
-    ERROR(PLUGIN_NAME ": Could not load JSON object from data passed in"
-                      " : %s",
-          error.text);
-    return -1;
-  } else if (!json_is_object(root)) {
-    ERROR(PLUGIN_NAME ": JSON Request is not a JSON object");
-    json_decref(root);
+
+  parser.depth = 0;
+  parser.have_data = false;
+  parser.in_data = false;
+  parser.in_stats = false;
+  parser.stats_num = 0;
+
+#if HAVE_YAJL_V2
+  yajl_handle hand = yajl_alloc(&dpdk_telemetry_callbacks, NULL, &parser);
+#else
+  yajl_handle hand =
+      yajl_alloc(&dpdk_telemetry_callbacks, NULL, NULL, &parser);
+#endif
+  if (hand == NULL) {
+    ERROR(PLUGIN_NAME ": yajl_alloc failed");
     return -1;
   }
 
-  status = json_object_get(root, "status_code");
-  if (!status) {
-    ERROR(PLUGIN_NAME ": Request does not have status field");
-    return -1;
-  } else if (!json_is_string(status)) {
-    ERROR(PLUGIN_NAME ": Status value is not a string");
+  yajl_status status =
+      yajl_parse(hand, (unsigned char *)buf, (yajl_len_t)len);
+  if (status == yajl_status_ok)
+#if HAVE_YAJL_V2
+    status = yajl_complete_parse(hand);
+#else
+    status = yajl_parse_complete(hand);
+#endif
+
+  if (status != yajl_status_ok) {
+    unsigned char *msg =
+        yajl_get_error(hand, /* verbose = */ 0, (unsigned char *)buf, len);
+    ERROR(PLUGIN_NAME ": Could not parse JSON reply: %s", (char *)msg);
+    yajl_free_error(hand, msg);
+    yajl_free(hand);
     return -1;
   }
-  dataArray = json_object_get(root, "data");
-  if (!dataArray) {
+  yajl_free(hand);
+
+  if (!parser.have_data) {
     ERROR(PLUGIN_NAME ": Request does not have data field");
     return -1;
   }
-  arraylen = json_array_size(dataArray);
-  if (!arraylen) {
-    ERROR(PLUGIN_NAME ": No data to get");
-    return -1;
-  }
-
-  for (i = 0; i < arraylen; i++) {
-    json_t *port;
-    dataArrayObj = json_array_get(dataArray, i);
-    port = json_object_get(dataArrayObj, "port");
-    stats = json_object_get(dataArrayObj, "stats");
-    if (!port) {
-      ERROR(PLUGIN_NAME ": Request does not have port field");
-      return -1;
-    }
-    if (!json_is_integer(port)) {
-      ERROR(PLUGIN_NAME ": Port value is not an integer");
-      return -1;
-    }
+  return 0;
+}
 
-    if (!stats) {
-      ERROR(PLUGIN_NAME ": Request does not have stats field");
+/* Receives one reply into "recv_buffer". The socket keeps message boundaries,
+ * so the size of the reply is looked up first and the buffer grown if
+ * needed. */
+static ssize_t dpdk_telemetry_recv(void) {
+  ssize_t len = recv(client.fd, NULL, 0, MSG_PEEK | MSG_TRUNC);
+  if (len < 0)
+    return len;
+
+  size_t need = ((size_t)len > BUF_SIZE) ? (size_t)len + 1 : BUF_SIZE;
+  if (recv_buffer_size < need) {
+    char *tmp = realloc(recv_buffer, need);
+    if (tmp == NULL) {
+      errno = ENOMEM;
       return -1;
     }
-    dpdk_telemetry_parse(stats, port);
+    recv_buffer = tmp;
+    recv_buffer_size = need;
   }
-  return 0;
+
+  len = recv(client.fd, recv_buffer, recv_buffer_size - 1, 0);
+  if (len >= 0)
+    recv_buffer[len] = '\0';
+  return len;
 }
 
 static int dpdk_telemetry_cleanup(void) {
@@ -323,6 +514,13 @@ static int dpdk_telemetry_shutdown(void) {
   char msg[BUF_SIZE];
   int ret;
 
+  sfree(recv_buffer);
+  recv_buffer_size = 0;
+  sfree(parser.stats);
+  parser.stats_size = 0;
+  sfree(parser.vls);
+  parser.vls_size = 0;
+
   snprintf(msg, sizeof(msg),
            "{\"action\":2,\"command\":\"clients\""
            ",\"data\":{\"client_path\":\"%s\"}}",
@@ -339,8 +537,8 @@ static int dpdk_telemetry_shutdown(void) {
 
 static int dpdk_telemetry_read(user_data_t *ud) {
   DEBUG(PLUGIN_NAME ": %s:%d", __FUNCTION__, __LINE__);
-  char buffer[BUF_SIZE];
-  int bytes = 0, ret;
+  ssize_t bytes = 0;
+  int ret;
   char *json_string[MAX_COMMANDS] = {"{\"action\":0,\"command\":"
                                      "\"ports_all_stat_values\",\"data\":null}",
                                      "{\"action\":0,\"command\":"
@@ -359,15 +557,14 @@ static int dpdk_telemetry_read(user_data_t *ud) {
         send(client.fd, json_string[i], strlen(json_string[i]), 0);
       }
     } else {
-      bytes = recv(client.fd, buffer, sizeof(buffer) - 1, 0);
+      bytes = dpdk_telemetry_recv();
       if (bytes < 0) {
         ERROR(PLUGIN_NAME ": Could not receive stats errno(%d), error(%s)",
               errno, strerror(errno));
         dpdk_telemetry_cleanup();
         dpdk_telemetry_socket_init();
       } else {
-        buffer[bytes] = '\0';
-        ret = parse_json(buffer);
+        ret = parse_json(recv_buffer, (size_t)bytes);
         if (ret < 0)
           ERROR(PLUGIN_NAME ": Parsing failed");
       }
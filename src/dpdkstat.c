@@ -81,6 +81,11 @@ struct dpdk_stats_ctx_s {
   uint32_t ports_count;
   cdtime_t port_read_time[RTE_MAX_ETHPORTS];
   uint32_t port_stats_count[RTE_MAX_ETHPORTS];
+  /* Set by the helper once the counters of all ports, their offsets and
+   * names are known. Until the counters change, it only reads the values. */
+  bool layout_valid;
+  /* Incremented by the helper whenever it has read the names again. */
+  uint32_t names_gen;
 #if RTE_VERSION < RTE_VERSION_16_07
   struct rte_eth_xstats *xstats;
 #else
@@ -102,6 +107,20 @@ dpdk_helper_ctx_t *g_hc = NULL;
 static char g_shm_name[DATA_MAX_NAME_LEN] = DPDK_STATS_NAME;
 static dpdk_stat_cfg_status g_state = DPDK_STAT_STATE_OKAY;
 
+/* Value lists of all counters. They are set up once per set of names (see
+ * "names_gen" above), each read only fills in the values and times. */
+typedef struct {
+  uint32_t stat; /* index into xstats */
+  int port;
+} dpdk_stats_vl_map_t;
+
+static value_list_t *g_vls;
+static value_t *g_values;
+static dpdk_stats_vl_map_t *g_vls_map;
+static size_t g_vls_num;
+static uint32_t g_vls_gen;
+static bool g_vls_valid;
+
 static int dpdk_stats_reinit_helper();
 static void dpdk_stats_default_config(void) {
   dpdk_stats_ctx_t *ec = DPDK_STATS_CTX_GET(g_hc);
@@ -240,6 +259,27 @@ static int dpdk_helper_stats_get(dpdk_helper_ctx_t *phc) {
   return 0;
 }
 
+/* Reads the values only, into the places found by dpdk_helper_stats_get().
+ * Fails if the number of counters of a port changed. */
+static int dpdk_helper_stats_values_get(dpdk_helper_ctx_t *phc) {
+  dpdk_stats_ctx_t *ctx = DPDK_STATS_CTX_GET(phc);
+  int stats = 0;
+
+  for (uint8_t i = 0; i < ctx->ports_count; i++) {
+    if (!(ctx->config.enabled_port_mask & (1 << i)))
+      continue;
+
+    int len = ctx->port_stats_count[i];
+    ctx->port_read_time[i] = cdtime();
+    int ret = rte_eth_xstats_get(i, &ctx->xstats[stats], len);
+    if (ret != len)
+      return -1;
+    stats += len;
+  }
+
+  return 0;
+}
+
 static int dpdk_helper_stats_count_get(dpdk_helper_ctx_t *phc) {
   uint8_t ports = dpdk_helper_eth_dev_count();
   if (ports == 0)
@@ -289,6 +329,13 @@ int dpdk_helper_command_handler(dpdk_helper_ctx_t *phc, enum DPDK_CMD cmd) {
     return -EINVAL;
   }
 
+  dpdk_stats_ctx_t *ctx = DPDK_STATS_CTX_GET(phc);
+  if (ctx->layout_valid && (dpdk_helper_eth_dev_count() == ctx->ports_count)) {
+    if (dpdk_helper_stats_values_get(phc) == 0)
+      return 0;
+  }
+  ctx->layout_valid = false;
+
   int stats_count = dpdk_helper_stats_count_get(phc);
   if (stats_count < 0) {
     return stats_count;
@@ -305,7 +352,12 @@ int dpdk_helper_command_handler(dpdk_helper_ctx_t *phc, enum DPDK_CMD cmd) {
     return -ENOBUFS;
   }
 
-  return dpdk_helper_stats_get(phc);
+  int ret = dpdk_helper_stats_get(phc);
+  if (ret == 0) {
+    ctx->layout_valid = true;
+    ctx->names_gen++;
+  }
+  return ret;
 }
 
 static void dpdk_stats_resolve_cnt_type(char *cnt_type, size_t cnt_type_len,
@@ -365,30 +417,34 @@ static void dpdk_stats_resolve_cnt_type(char *cnt_type, size_t cnt_type_len,
   }
 }
 
-static void dpdk_stats_counter_submit(const char *plugin_instance,
-                                      const char *cnt_name, derive_t value,
-                                      cdtime_t port_read_time) {
-  value_list_t vl = VALUE_LIST_INIT;
-  vl.values = &(value_t){.derive = value};
-  vl.values_len = 1;
-  vl.time = port_read_time;
-  sstrncpy(vl.plugin, DPDK_STATS_PLUGIN, sizeof(vl.plugin));
-  sstrncpy(vl.plugin_instance, plugin_instance, sizeof(vl.plugin_instance));
-  dpdk_stats_resolve_cnt_type(vl.type, sizeof(vl.type), cnt_name);
-  sstrncpy(vl.type_instance, cnt_name, sizeof(vl.type_instance));
-  plugin_dispatch_values(&vl);
+static void dpdk_stats_vls_free(void) {
+  sfree(g_vls);
+  sfree(g_values);
+  sfree(g_vls_map);
+  g_vls_num = 0;
+  g_vls_valid = false;
 }
 
-static int dpdk_stats_counters_dispatch(dpdk_helper_ctx_t *phc) {
-  dpdk_stats_ctx_t *ctx = DPDK_STATS_CTX_GET(phc);
-
-  /* dispatch stats values to collectd */
+static int dpdk_stats_vls_build(dpdk_stats_ctx_t *ctx) {
+  dpdk_stats_vls_free();
 
-  DEBUG("%s:%s:%d ports=%u", DPDK_STATS_PLUGIN, __FUNCTION__, __LINE__,
-        ctx->ports_count);
+  size_t num = 0;
+  for (int i = 0; i < ctx->ports_count; i++)
+    if (ctx->config.enabled_port_mask & (1 << i))
+      num += ctx->port_stats_count[i];
+  if (num == 0)
+    return 0;
 
-  int stats_count = 0;
+  g_vls = calloc(num, sizeof(*g_vls));
+  g_values = calloc(num, sizeof(*g_values));
+  g_vls_map = calloc(num, sizeof(*g_vls_map));
+  if (g_vls == NULL || g_values == NULL || g_vls_map == NULL) {
+    ERROR(DPDK_STATS_PLUGIN ": calloc failed.");
+    dpdk_stats_vls_free();
+    return -1;
+  }
 
+  uint32_t stats_count = 0;
   for (int i = 0; i < ctx->ports_count; i++) {
     if (!(ctx->config.enabled_port_mask & (1 << i)))
       continue;
@@ -400,24 +456,60 @@ static int dpdk_stats_counters_dispatch(dpdk_helper_ctx_t *phc) {
       ssnprintf(dev_name, sizeof(dev_name), "port.%d", i);
     }
 
-    DEBUG(" === Dispatch stats for port %d (name=%s; stats_count=%d)", i,
-          dev_name, ctx->port_stats_count[i]);
+    for (int j = 0; j < ctx->port_stats_count[i]; j++, stats_count++) {
+      assert(stats_count < ctx->stats_count);
 
-    for (int j = 0; j < ctx->port_stats_count[i]; j++) {
       const char *cnt_name = DPDK_STATS_XSTAT_GET_NAME(ctx, stats_count);
-      if (cnt_name == NULL)
+      if (cnt_name == NULL || cnt_name[0] == 0) {
         WARNING("dpdkstat: Invalid counter name");
-      else
-        dpdk_stats_counter_submit(
-            dev_name, cnt_name,
-            (derive_t)DPDK_STATS_XSTAT_GET_VALUE(ctx, stats_count),
-            ctx->port_read_time[i]);
-      stats_count++;
-
-      assert(stats_count <= ctx->stats_count);
+        continue;
+      }
+
+      value_list_t *vl = g_vls + g_vls_num;
+      *vl = (value_list_t){
+          .values = g_values + g_vls_num,
+          .values_len = 1,
+      };
+      sstrncpy(vl->plugin, DPDK_STATS_PLUGIN, sizeof(vl->plugin));
+      sstrncpy(vl->plugin_instance, dev_name, sizeof(vl->plugin_instance));
+      dpdk_stats_resolve_cnt_type(vl->type, sizeof(vl->type), cnt_name);
+      sstrncpy(vl->type_instance, cnt_name, sizeof(vl->type_instance));
+
+      g_vls_map[g_vls_num] = (dpdk_stats_vl_map_t){
+          .stat = stats_count,
+          .port = i,
+      };
+      g_vls_num++;
     }
   }
 
+  g_vls_gen = ctx->names_gen;
+  g_vls_valid = true;
+  return 0;
+}
+
+static int dpdk_stats_counters_dispatch(dpdk_helper_ctx_t *phc) {
+  dpdk_stats_ctx_t *ctx = DPDK_STATS_CTX_GET(phc);
+
+  /* dispatch stats values to collectd */
+
+  DEBUG("%s:%s:%d ports=%u", DPDK_STATS_PLUGIN, __FUNCTION__, __LINE__,
+        ctx->ports_count);
+
+  if (!g_vls_valid || (g_vls_gen != ctx->names_gen)) {
+    if (dpdk_stats_vls_build(ctx) != 0)
+      return -1;
+  }
+
+  for (size_t i = 0; i < g_vls_num; i++) {
+    dpdk_stats_vl_map_t const *m = g_vls_map + i;
+    g_values[i].derive = (derive_t)DPDK_STATS_XSTAT_GET_VALUE(ctx, m->stat);
+    g_vls[i].time = ctx->port_read_time[m->port];
+  }
+
+  if (g_vls_num > 0)
+    plugin_dispatch_value_lists(g_vls, g_vls_num);
+
   return 0;
 }
 
@@ -452,6 +544,8 @@ static int dpdk_stats_reinit_helper() {
 
   ctx = DPDK_STATS_CTX_GET(g_hc);
   memcpy(ctx, &tmp_ctx, sizeof(dpdk_stats_ctx_t));
+  /* The counters move to the new shared memory; look them up again. */
+  ctx->layout_valid = false;
   DPDK_STATS_CTX_INIT(ctx);
   dpdk_helper_eal_config_set(g_hc, &tmp_eal);
 
@@ -493,6 +587,7 @@ static int dpdk_stats_shutdown(void) {
 
   dpdk_helper_shutdown(g_hc);
   g_hc = NULL;
+  dpdk_stats_vls_free();
 
   return 0;
 }
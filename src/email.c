@@ -38,16 +38,24 @@
  * c:<type1>[,<type2>,...]
  */
 
+#define _GNU_SOURCE /* For accept4 and pipe2 */
+
 #include "collectd.h"
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils_complain.h"
 
 #include <stddef.h>
 
 #include <sys/select.h>
 #include <sys/un.h>
 
+#if HAVE_SYS_EPOLL_H
+#include <fcntl.h>
+#include <sys/epoll.h>
+#endif
+
 /* some systems (e.g. Darwin) seem to not define UNIX_PATH_MAX at all */
 #ifndef UNIX_PATH_MAX
 #define UNIX_PATH_MAX sizeof(((struct sockaddr_un *)0)->sun_path)
@@ -60,6 +68,10 @@
 #define SOCK_PATH LOCALSTATEDIR "/run/" PACKAGE_NAME "-email"
 #define MAX_CONNS 5
 #define MAX_CONNS_LIMIT 16384
+#define THREADS_LIMIT 64
+
+/* Maximum length of a line, including the newline. */
+#define LINE_MAX_LEN 256
 
 #define log_debug(...) DEBUG("email: "__VA_ARGS__)
 #define log_err(...) ERROR("email: "__VA_ARGS__)
@@ -80,12 +92,28 @@ typedef struct {
   type_t *tail;
 } type_list_t;
 
+/* Counters updated by one thread. They are merged by email_read(), so the
+ * threads don't compete for a lock while handling lines. */
+typedef struct {
+  pthread_mutex_t lock;
+
+  type_list_t count;
+  type_list_t size;
+  type_list_t check;
+
+  double score_sum;
+  int score_count;
+} email_stats_t;
+
+#if !HAVE_SYS_EPOLL_H
 /* collector thread control information */
 typedef struct collector {
   pthread_t thread;
 
   /* socket descriptor of the current/last connection */
   FILE *socket;
+
+  email_stats_t *stats;
 } collector_t;
 
 /* linked list of pending connections */
@@ -101,13 +129,14 @@ typedef struct {
   conn_t *head;
   conn_t *tail;
 } conn_list_t;
+#endif /* !HAVE_SYS_EPOLL_H */
 
 /*
  * Private variables
  */
 /* valid configuration file keys */
 static const char *config_keys[] = {"SocketFile", "SocketGroup", "SocketPerms",
-                                    "MaxConns"};
+                                    "MaxConns", "Threads"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 /* socket configuration */
@@ -115,13 +144,49 @@ static char *sock_file;
 static char *sock_group;
 static int sock_perms = S_IRWXU | S_IRWXG;
 static int max_conns = MAX_CONNS;
+static int threads_num = 1;
 
 /* state of the plugin */
 static int disabled;
 
+static int connector_socket = -1;
+
+/* one set of counters per thread handling connections */
+static email_stats_t *stats;
+static size_t stats_num;
+
+/* merged counters, keeping every type seen so far */
+static type_list_t list_count;
+static type_list_t list_size;
+static type_list_t list_check;
+
+#if HAVE_SYS_EPOLL_H
+/* a client connection and its partial line */
+typedef struct email_conn_s {
+  int fd;
+  char buffer[LINE_MAX_LEN + 1];
+  size_t fill;
+  /* skip the rest of a line that didn't fit into the buffer */
+  bool discard;
+  struct email_conn_s *prev;
+  struct email_conn_s *next;
+} email_conn_t;
+
+static int epoll_fd = -1;
+static int wakeup_pipe[2] = {-1, -1};
+static pthread_t *worker_threads;
+static size_t worker_threads_num;
+static volatile bool worker_loop;
+
+static pthread_mutex_t conn_lock = PTHREAD_MUTEX_INITIALIZER;
+static email_conn_t *conn_head;
+
+/* markers for the two file descriptors that are not connections */
+static char listen_marker;
+static char wakeup_marker;
+#else  /* !HAVE_SYS_EPOLL_H */
 /* thread managing "client" connections */
 static pthread_t connector = (pthread_t)0;
-static int connector_socket = -1;
 
 /* tell the collector threads that a new connection is available */
 static pthread_cond_t conn_available = PTHREAD_COND_INITIALIZER;
@@ -138,22 +203,7 @@ static collector_t **collectors;
 
 static pthread_mutex_t available_mutex = PTHREAD_MUTEX_INITIALIZER;
 static int available_collectors;
-
-static pthread_mutex_t count_mutex = PTHREAD_MUTEX_INITIALIZER;
-static type_list_t list_count;
-static type_list_t list_count_copy;
-
-static pthread_mutex_t size_mutex = PTHREAD_MUTEX_INITIALIZER;
-static type_list_t list_size;
-static type_list_t list_size_copy;
-
-static pthread_mutex_t score_mutex = PTHREAD_MUTEX_INITIALIZER;
-static double score;
-static int score_count;
-
-static pthread_mutex_t check_mutex = PTHREAD_MUTEX_INITIALIZER;
-static type_list_t list_check;
-static type_list_t list_check_copy;
+#endif /* HAVE_SYS_EPOLL_H */
 
 /*
  * Private functions
@@ -194,6 +244,14 @@ static int email_config(const char *key, const char *value) {
     } else {
       max_conns = (int)tmp;
     }
+  } else if (strcasecmp(key, "Threads") == 0) {
+    int tmp = atoi(value);
+    if ((tmp < 1) || (tmp > THREADS_LIMIT)) {
+      ERROR("email plugin: `Threads' must be between 1 and %i, got `%s'.",
+            THREADS_LIMIT, value);
+      return 1;
+    }
+    threads_num = tmp;
   } else {
     return -1;
   }
@@ -232,6 +290,380 @@ static void type_list_incr(type_list_t *list, char *name, int incr) {
   return;
 } /* static void type_list_incr (type_list_t *, char *) */
 
+/* Updates the counters in "st" from one line, without the newline. Must be
+ * called with st->lock held. */
+static void handle_line(email_stats_t *st, char *line) {
+  size_t len = strlen(line);
+  if ((len > 0) && (line[len - 1] == '\r'))
+    line[--len] = '\0';
+  if (len < 2) { /* [a-z] ':' */
+    return;
+  }
+
+  log_debug("collect: line = '%s'", line);
+
+  if (line[1] != ':') {
+    log_err("collect: syntax error in line '%s'", line);
+    return;
+  }
+
+  if (line[0] == 'e') { /* e:<type>:<bytes> */
+    char *type = line + 2;
+    char *bytes_str = strchr(type, ':');
+    if (bytes_str == NULL) {
+      log_err("collect: syntax error in line '%s'", line);
+      return;
+    }
+
+    *bytes_str = 0;
+    bytes_str++;
+
+    type_list_incr(&st->count, type, /* increment = */ 1);
+
+    int bytes = atoi(bytes_str);
+    if (bytes > 0)
+      type_list_incr(&st->size, type, /* increment = */ bytes);
+  } else if (line[0] == 's') { /* s:<value> */
+    st->score_sum += atof(line + 2);
+    ++st->score_count;
+  } else if (line[0] == 'c') { /* c:<type1>[,<type2>,...] */
+    char *dummy = line + 2;
+    char *endptr = NULL;
+    char *type;
+
+    while ((type = strtok_r(dummy, ",", &endptr)) != NULL) {
+      dummy = NULL;
+      type_list_incr(&st->check, type, /* increment = */ 1);
+    }
+  } else {
+    log_err("collect: unknown type '%c'", line[0]);
+  }
+} /* static void handle_line (email_stats_t *, char *) */
+
+/* Creates the listening UNIX socket in connector_socket. */
+static int open_socket(void) {
+  const char *path = (NULL == sock_file) ? SOCK_PATH : sock_file;
+  const char *group = (NULL == sock_group) ? COLLECTD_GRP_NAME : sock_group;
+
+  /* create UNIX socket */
+  errno = 0;
+  if ((connector_socket = socket(PF_UNIX, SOCK_STREAM, 0)) == -1) {
+    log_err("socket() failed: %s", STRERRNO);
+    return -1;
+  }
+
+  struct sockaddr_un addr = {
+      .sun_family = AF_UNIX,
+  };
+  sstrncpy(addr.sun_path, path, (size_t)(UNIX_PATH_MAX - 1));
+
+  errno = 0;
+  if (bind(connector_socket, (struct sockaddr *)&addr,
+           offsetof(struct sockaddr_un, sun_path) + strlen(addr.sun_path)) ==
+      -1) {
+    close(connector_socket);
+    connector_socket = -1;
+    log_err("bind() failed: %s", STRERRNO);
+    return -1;
+  }
+
+  errno = 0;
+  if (listen(connector_socket, 5) == -1) {
+    close(connector_socket);
+    connector_socket = -1;
+    log_err("listen() failed: %s", STRERRNO);
+    return -1;
+  }
+
+  {
+    struct group sg;
+    struct group *grp;
+    int status;
+
+    long int grbuf_size = sysconf(_SC_GETGR_R_SIZE_MAX);
+    if (grbuf_size <= 0)
+      grbuf_size = sysconf(_SC_PAGESIZE);
+    if (grbuf_size <= 0)
+      grbuf_size = 4096;
+    char grbuf[grbuf_size];
+
+    grp = NULL;
+    status = getgrnam_r(group, &sg, grbuf, sizeof(grbuf), &grp);
+    if (status != 0) {
+      log_warn("getgrnam_r (%s) failed: %s", group, STRERROR(status));
+    } else if (grp == NULL) {
+      log_warn("No such group: `%s'", group);
+    } else {
+      status = chown(path, (uid_t)-1, grp->gr_gid);
+      if (status != 0) {
+        log_warn("chown (%s, -1, %i) failed: %s", path, (int)grp->gr_gid,
+                 STRERRNO);
+      }
+    }
+  }
+
+  errno = 0;
+  if (chmod(path, sock_perms) != 0) {
+    log_warn("chmod() failed: %s", STRERRNO);
+  }
+
+  return 0;
+} /* static int open_socket (void) */
+
+#if HAVE_SYS_EPOLL_H
+/*
+ * Connections are multiplexed by "Threads" threads sharing one epoll(7)
+ * instance, so the number of clients is not limited by the number of
+ * threads. Every connection is registered with EPOLLONESHOT, so that only one
+ * thread reads from it at a time; the thread re-arms it when done.
+ */
+static void conn_destroy(email_conn_t *c) {
+  pthread_mutex_lock(&conn_lock);
+  if (c->prev != NULL)
+    c->prev->next = c->next;
+  else
+    conn_head = c->next;
+  if (c->next != NULL)
+    c->next->prev = c->prev;
+  pthread_mutex_unlock(&conn_lock);
+
+  log_debug("Shutting down connection on fd #%i", c->fd);
+  close(c->fd);
+  sfree(c);
+} /* static void conn_destroy (email_conn_t *) */
+
+static void conn_accept(void) {
+  static c_complain_t complaint = C_COMPLAIN_INIT_STATIC;
+
+  while (42) {
+    int fd =
+        accept4(connector_socket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+        c_complain(LOG_ERR, &complaint, "email: accept() failed: %s",
+                   STRERRNO);
+      return;
+    }
+    c_release(LOG_INFO, &complaint, "email: Accepting connections again.");
+
+    email_conn_t *c = calloc(1, sizeof(*c));
+    if (c == NULL) {
+      log_err("calloc failed.");
+      close(fd);
+      continue;
+    }
+    c->fd = fd;
+
+    pthread_mutex_lock(&conn_lock);
+    c->next = conn_head;
+    if (c->next != NULL)
+      c->next->prev = c;
+    conn_head = c;
+    pthread_mutex_unlock(&conn_lock);
+
+    log_debug("handling connection on fd #%i", fd);
+
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLONESHOT, .data.ptr = c};
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+      log_err("epoll_ctl() failed: %s", STRERRNO);
+      conn_destroy(c);
+    }
+  }
+} /* static void conn_accept (void) */
+
+/* Handles all complete lines in the buffer of "c". At the end of the input,
+ * a last line without a newline is handled, too. */
+static void conn_parse(email_conn_t *c, email_stats_t *st, bool eof) {
+  size_t pos = 0;
+
+  pthread_mutex_lock(&st->lock);
+  while (pos < c->fill) {
+    char *line = c->buffer + pos;
+    char *eol = memchr(line, '\n', c->fill - pos);
+    if (eol == NULL) {
+      if (!eof)
+        break;
+      eol = c->buffer + c->fill;
+    }
+
+    *eol = '\0';
+    pos = (size_t)(eol - c->buffer) + 1;
+
+    if (c->discard)
+      c->discard = false;
+    else
+      handle_line(st, line);
+  }
+  pthread_mutex_unlock(&st->lock);
+
+  if (pos >= c->fill) {
+    c->fill = 0;
+    return;
+  }
+
+  memmove(c->buffer, c->buffer + pos, c->fill - pos);
+  c->fill -= pos;
+
+  if (c->fill < LINE_MAX_LEN)
+    return;
+
+  if (!c->discard) {
+    c->buffer[c->fill] = '\0';
+    log_warn("collect: line too long (> %i characters): '%s' (truncated)",
+             LINE_MAX_LEN - 1, c->buffer);
+  }
+  c->discard = true;
+  c->fill = 0;
+} /* static void conn_parse (email_conn_t *, email_stats_t *, bool) */
+
+/* Reads the available input. Returns non-zero on error or when the client
+ * went away. */
+static int conn_read(email_conn_t *c, email_stats_t *st) {
+  while (42) {
+    ssize_t status =
+        read(c->fd, c->buffer + c->fill, LINE_MAX_LEN - c->fill);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        return 0;
+      log_err("collect: reading from socket (fd #%i) failed: %s", c->fd,
+              STRERRNO);
+      return -1;
+    } else if (status == 0) {
+      conn_parse(c, st, /* eof = */ true);
+      return -1;
+    }
+
+    c->fill += (size_t)status;
+    conn_parse(c, st, /* eof = */ false);
+  }
+} /* static int conn_read (email_conn_t *, email_stats_t *) */
+
+static void *worker_thread(void *arg) {
+  email_stats_t *st = arg;
+  struct epoll_event events[16];
+
+  while (worker_loop) {
+    int events_num =
+        epoll_wait(epoll_fd, events, STATIC_ARRAY_SIZE(events), -1);
+    if (events_num < 0) {
+      if (errno == EINTR)
+        continue;
+      log_err("epoll_wait() failed: %s", STRERRNO);
+      break;
+    }
+
+    for (int i = 0; i < events_num; i++) {
+      if (events[i].data.ptr == &wakeup_marker)
+        continue;
+      if (events[i].data.ptr == &listen_marker) {
+        conn_accept();
+        continue;
+      }
+
+      email_conn_t *c = events[i].data.ptr;
+      if (conn_read(c, st) != 0) {
+        conn_destroy(c);
+        continue;
+      }
+
+      struct epoll_event ev = {.events = EPOLLIN | EPOLLONESHOT,
+                               .data.ptr = c};
+      if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c->fd, &ev) != 0) {
+        log_err("epoll_ctl() failed: %s", STRERRNO);
+        conn_destroy(c);
+      }
+    }
+  }
+
+  return (void *)0;
+} /* static void *worker_thread (void *) */
+
+static int server_start(void) {
+  if (open_socket() != 0)
+    return -1;
+
+  int flags = fcntl(connector_socket, F_GETFL);
+  if ((flags < 0) ||
+      (fcntl(connector_socket, F_SETFL, flags | O_NONBLOCK) != 0)) {
+    log_err("fcntl() failed: %s", STRERRNO);
+    return -1;
+  }
+
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd < 0) {
+    log_err("epoll_create1() failed: %s", STRERRNO);
+    return -1;
+  }
+
+  if (pipe2(wakeup_pipe, O_CLOEXEC) != 0) {
+    log_err("pipe2() failed: %s", STRERRNO);
+    return -1;
+  }
+
+  struct epoll_event ev_listen = {.events = EPOLLIN,
+                                  .data.ptr = &listen_marker};
+  struct epoll_event ev_wakeup = {.events = EPOLLIN,
+                                  .data.ptr = &wakeup_marker};
+  if ((epoll_ctl(epoll_fd, EPOLL_CTL_ADD, connector_socket, &ev_listen) !=
+       0) ||
+      (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wakeup_pipe[0], &ev_wakeup) != 0)) {
+    log_err("epoll_ctl() failed: %s", STRERRNO);
+    return -1;
+  }
+
+  worker_threads = calloc(stats_num, sizeof(*worker_threads));
+  if (worker_threads == NULL) {
+    log_err("calloc failed.");
+    return -1;
+  }
+
+  worker_loop = true;
+  for (size_t i = 0; i < stats_num; i++) {
+    if (plugin_thread_create(worker_threads + worker_threads_num,
+                             worker_thread, stats + i, "email worker") != 0) {
+      log_err("plugin_thread_create() failed: %s", STRERRNO);
+      break;
+    }
+    worker_threads_num++;
+  }
+
+  return (worker_threads_num > 0) ? 0 : -1;
+} /* static int server_start (void) */
+
+static void server_stop(void) {
+  worker_loop = false;
+
+  /* The pipe stays readable, so every worker wakes up and sees the flag. */
+  if (wakeup_pipe[1] >= 0) {
+    if (write(wakeup_pipe[1], "", 1) < 0)
+      log_err("write() to wakeup pipe failed: %s", STRERRNO);
+  }
+
+  for (size_t i = 0; i < worker_threads_num; i++)
+    pthread_join(worker_threads[i], NULL);
+  sfree(worker_threads);
+  worker_threads_num = 0;
+
+  while (conn_head != NULL)
+    conn_destroy(conn_head);
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(wakeup_pipe); i++) {
+    if (wakeup_pipe[i] >= 0)
+      close(wakeup_pipe[i]);
+    wakeup_pipe[i] = -1;
+  }
+  if (epoll_fd >= 0)
+    close(epoll_fd);
+  epoll_fd = -1;
+
+  if (connector_socket >= 0) {
+    close(connector_socket);
+    connector_socket = -1;
+  }
+} /* static void server_stop (void) */
+#else  /* !HAVE_SYS_EPOLL_H */
 static void *collect(void *arg) {
   collector_t *this = (collector_t *)arg;
 
@@ -260,8 +692,7 @@ static void *collect(void *arg) {
     log_debug("collect: handling connection on fd #%i", fileno(this->socket));
 
     while (42) {
-      /* 256 bytes ought to be enough for anybody ;-) */
-      char line[256 + 1]; /* line + '\0' */
+      char line[LINE_MAX_LEN + 1]; /* line + '\0' */
 
       errno = 0;
       if (fgets(line, sizeof(line), this->socket) == NULL) {
@@ -279,65 +710,19 @@ static void *collect(void *arg) {
                  "'%s' (truncated)",
                  sizeof(line) - 1, line);
 
-        while (fgets(line, sizeof(line), this->socket) != NULL)
+        while (fgets(line, sizeof(line), this->socket) != NULL) {
+          len = strlen(line);
           if ((line[len - 1] == '\n') || (line[len - 1] == '\r'))
             break;
-        continue;
-      }
-      if (len < 3) { /* [a-z] ':' '\n' */
+        }
         continue;
       }
 
       line[len - 1] = '\0';
 
-      log_debug("collect: line = '%s'", line);
-
-      if (line[1] != ':') {
-        log_err("collect: syntax error in line '%s'", line);
-        continue;
-      }
-
-      if (line[0] == 'e') { /* e:<type>:<bytes> */
-        char *type = line + 2;
-        char *bytes_str = strchr(type, ':');
-        if (bytes_str == NULL) {
-          log_err("collect: syntax error in line '%s'", line);
-          continue;
-        }
-
-        *bytes_str = 0;
-        bytes_str++;
-
-        pthread_mutex_lock(&count_mutex);
-        type_list_incr(&list_count, type, /* increment = */ 1);
-        pthread_mutex_unlock(&count_mutex);
-
-        int bytes = atoi(bytes_str);
-        if (bytes > 0) {
-          pthread_mutex_lock(&size_mutex);
-          type_list_incr(&list_size, type, /* increment = */ bytes);
-          pthread_mutex_unlock(&size_mutex);
-        }
-      } else if (line[0] == 's') { /* s:<value> */
-        pthread_mutex_lock(&score_mutex);
-        score = (score * (double)score_count + atof(line + 2)) /
-                (double)(score_count + 1);
-        ++score_count;
-        pthread_mutex_unlock(&score_mutex);
-      } else if (line[0] == 'c') { /* c:<type1>[,<type2>,...] */
-        char *dummy = line + 2;
-        char *endptr = NULL;
-        char *type;
-
-        pthread_mutex_lock(&check_mutex);
-        while ((type = strtok_r(dummy, ",", &endptr)) != NULL) {
-          dummy = NULL;
-          type_list_incr(&list_check, type, /* increment = */ 1);
-        }
-        pthread_mutex_unlock(&check_mutex);
-      } else {
-        log_err("collect: unknown type '%c'", line[0]);
-      }
+      pthread_mutex_lock(&this->stats->lock);
+      handle_line(this->stats, line);
+      pthread_mutex_unlock(&this->stats->lock);
     } /* while (42) */
 
     log_debug("Shutting down connection on fd #%i", fileno(this->socket));
@@ -359,74 +744,11 @@ static void *collect(void *arg) {
 } /* static void *collect (void *) */
 
 static void *open_connection(void __attribute__((unused)) * arg) {
-  const char *path = (NULL == sock_file) ? SOCK_PATH : sock_file;
-  const char *group = (NULL == sock_group) ? COLLECTD_GRP_NAME : sock_group;
-
-  /* create UNIX socket */
-  errno = 0;
-  if ((connector_socket = socket(PF_UNIX, SOCK_STREAM, 0)) == -1) {
+  if (open_socket() != 0) {
     disabled = 1;
-    log_err("socket() failed: %s", STRERRNO);
     pthread_exit((void *)1);
   }
 
-  struct sockaddr_un addr = {
-      .sun_family = AF_UNIX,
-  };
-  sstrncpy(addr.sun_path, path, (size_t)(UNIX_PATH_MAX - 1));
-
-  errno = 0;
-  if (bind(connector_socket, (struct sockaddr *)&addr,
-           offsetof(struct sockaddr_un, sun_path) + strlen(addr.sun_path)) ==
-      -1) {
-    disabled = 1;
-    close(connector_socket);
-    connector_socket = -1;
-    log_err("bind() failed: %s", STRERRNO);
-    pthread_exit((void *)1);
-  }
-
-  errno = 0;
-  if (listen(connector_socket, 5) == -1) {
-    disabled = 1;
-    close(connector_socket);
-    connector_socket = -1;
-    log_err("listen() failed: %s", STRERRNO);
-    pthread_exit((void *)1);
-  }
-
-  {
-    struct group sg;
-    struct group *grp;
-    int status;
-
-    long int grbuf_size = sysconf(_SC_GETGR_R_SIZE_MAX);
-    if (grbuf_size <= 0)
-      grbuf_size = sysconf(_SC_PAGESIZE);
-    if (grbuf_size <= 0)
-      grbuf_size = 4096;
-    char grbuf[grbuf_size];
-
-    grp = NULL;
-    status = getgrnam_r(group, &sg, grbuf, sizeof(grbuf), &grp);
-    if (status != 0) {
-      log_warn("getgrnam_r (%s) failed: %s", group, STRERROR(status));
-    } else if (grp == NULL) {
-      log_warn("No such group: `%s'", group);
-    } else {
-      status = chown(path, (uid_t)-1, grp->gr_gid);
-      if (status != 0) {
-        log_warn("chown (%s, -1, %i) failed: %s", path, (int)grp->gr_gid,
-                 STRERRNO);
-      }
-    }
-  }
-
-  errno = 0;
-  if (chmod(path, sock_perms) != 0) {
-    log_warn("chmod() failed: %s", STRERRNO);
-  }
-
   { /* initialize collector threads */
     conns.head = NULL;
     conns.tail = NULL;
@@ -438,6 +760,7 @@ static void *open_connection(void __attribute__((unused)) * arg) {
     for (int i = 0; i < max_conns; ++i) {
       collectors[i] = smalloc(sizeof(*collectors[i]));
       collectors[i]->socket = NULL;
+      collectors[i]->stats = stats + i;
 
       if (plugin_thread_create(&collectors[i]->thread, collect, collectors[i],
                                "email collector") == 0) {
@@ -516,14 +839,38 @@ static void *open_connection(void __attribute__((unused)) * arg) {
   pthread_exit((void *)0);
   return (void *)0;
 } /* static void *open_connection (void *) */
+#endif /* HAVE_SYS_EPOLL_H */
 
 static int email_init(void) {
+#if HAVE_SYS_EPOLL_H
+  stats_num = (size_t)threads_num;
+#else
+  stats_num = (size_t)max_conns;
+#endif
+
+  stats = calloc(stats_num, sizeof(*stats));
+  if (stats == NULL) {
+    disabled = 1;
+    stats_num = 0;
+    log_err("calloc failed.");
+    return -1;
+  }
+  for (size_t i = 0; i < stats_num; i++)
+    pthread_mutex_init(&stats[i].lock, NULL);
+
+#if HAVE_SYS_EPOLL_H
+  if (server_start() != 0) {
+    disabled = 1;
+    return -1;
+  }
+#else
   if (plugin_thread_create(&connector, open_connection, NULL,
                            "email listener") != 0) {
     disabled = 1;
     log_err("plugin_thread_create() failed: %s", STRERRNO);
     return -1;
   }
+#endif
 
   return 0;
 } /* int email_init */
@@ -546,6 +893,9 @@ static void type_list_free(type_list_t *t) {
 }
 
 static int email_shutdown(void) {
+#if HAVE_SYS_EPOLL_H
+  server_stop();
+#else
   if (connector != ((pthread_t)0)) {
     pthread_kill(connector, SIGTERM);
     connector = (pthread_t)0;
@@ -583,12 +933,23 @@ static int email_shutdown(void) {
 
   pthread_mutex_unlock(&conns_mutex);
 
+  /* the collector threads may still be using their counters */
+  stats = NULL;
+  stats_num = 0;
+#endif /* HAVE_SYS_EPOLL_H */
+
+  for (size_t i = 0; i < stats_num; i++) {
+    type_list_free(&stats[i].count);
+    type_list_free(&stats[i].size);
+    type_list_free(&stats[i].check);
+    pthread_mutex_destroy(&stats[i].lock);
+  }
+  sfree(stats);
+  stats_num = 0;
+
   type_list_free(&list_count);
-  type_list_free(&list_count_copy);
   type_list_free(&list_size);
-  type_list_free(&list_size_copy);
   type_list_free(&list_check);
-  type_list_free(&list_check_copy);
 
   unlink((sock_file == NULL) ? SOCK_PATH : sock_file);
 
@@ -610,89 +971,66 @@ static void email_submit(const char *type, const char *type_instance,
   plugin_dispatch_values(&vl);
 } /* void email_submit */
 
-/* Copy list l1 to list l2. l2 may partly exist already, but it is assumed
- * that neither the order nor the name of any element of either list is
- * changed and no elements are deleted. The values of l1 are reset to zero
- * after they have been copied to l2. */
-static void copy_type_list(type_list_t *l1, type_list_t *l2) {
-  type_t *last = NULL;
-
-  for (type_t *ptr1 = l1->head, *ptr2 = l2->head; ptr1 != NULL;
-       ptr1 = ptr1->next, last = ptr2, ptr2 = ptr2->next) {
-    if (ptr2 == NULL) {
-      ptr2 = smalloc(sizeof(*ptr2));
-      ptr2->name = NULL;
-      ptr2->next = NULL;
-
-      if (last == NULL) {
-        l2->head = ptr2;
-      } else {
-        last->next = ptr2;
-      }
-
-      l2->tail = ptr2;
-    }
-
-    if (ptr2->name == NULL) {
-      ptr2->name = sstrdup(ptr1->name);
-    }
-
-    ptr2->value = ptr1->value;
-    ptr1->value = 0;
+/* Adds the values of list l1 to list l2 and resets them to zero. Types that
+ * are not in l2 yet are appended. */
+static void type_list_merge(type_list_t *l1, type_list_t *l2) {
+  for (type_t *ptr = l1->head; ptr != NULL; ptr = ptr->next) {
+    type_list_incr(l2, ptr->name, ptr->value);
+    ptr->value = 0;
   }
-  return;
+}
+
+static void type_list_reset(type_list_t *l) {
+  for (type_t *ptr = l->head; ptr != NULL; ptr = ptr->next)
+    ptr->value = 0;
 }
 
 static int email_read(void) {
-  double score_old;
-  int score_count_old;
+  double score_sum = 0.0;
+  int score_count = 0;
 
   if (disabled)
     return -1;
 
-  /* email count */
-  pthread_mutex_lock(&count_mutex);
+  /* Types seen before are reported with zero if they didn't occur during
+   * this interval. */
+  type_list_reset(&list_count);
+  type_list_reset(&list_size);
+  type_list_reset(&list_check);
 
-  copy_type_list(&list_count, &list_count_copy);
+  for (size_t i = 0; i < stats_num; i++) {
+    email_stats_t *st = stats + i;
 
-  pthread_mutex_unlock(&count_mutex);
+    pthread_mutex_lock(&st->lock);
 
-  for (type_t *ptr = list_count_copy.head; ptr != NULL; ptr = ptr->next) {
-    email_submit("email_count", ptr->name, ptr->value);
-  }
+    type_list_merge(&st->count, &list_count);
+    type_list_merge(&st->size, &list_size);
+    type_list_merge(&st->check, &list_check);
 
-  /* email size */
-  pthread_mutex_lock(&size_mutex);
+    score_sum += st->score_sum;
+    score_count += st->score_count;
+    st->score_sum = 0.0;
+    st->score_count = 0;
 
-  copy_type_list(&list_size, &list_size_copy);
+    pthread_mutex_unlock(&st->lock);
+  }
 
-  pthread_mutex_unlock(&size_mutex);
+  /* email count */
+  for (type_t *ptr = list_count.head; ptr != NULL; ptr = ptr->next) {
+    email_submit("email_count", ptr->name, ptr->value);
+  }
 
-  for (type_t *ptr = list_size_copy.head; ptr != NULL; ptr = ptr->next) {
+  /* email size */
+  for (type_t *ptr = list_size.head; ptr != NULL; ptr = ptr->next) {
     email_submit("email_size", ptr->name, ptr->value);
   }
 
   /* spam score */
-  pthread_mutex_lock(&score_mutex);
-
-  score_old = score;
-  score_count_old = score_count;
-  score = 0.0;
-  score_count = 0;
-
-  pthread_mutex_unlock(&score_mutex);
-
-  if (score_count_old > 0)
-    email_submit("spam_score", "", score_old);
+  if (score_count > 0)
+    email_submit("spam_score", "", score_sum / (double)score_count);
 
   /* spam checks */
-  pthread_mutex_lock(&check_mutex);
-
-  copy_type_list(&list_check, &list_check_copy);
-
-  pthread_mutex_unlock(&check_mutex);
-
-  for (type_t *ptr = list_check_copy.head; ptr != NULL; ptr = ptr->next)
+  for (type_t *ptr = list_check.head; ptr != NULL; ptr = ptr->next)
     email_submit("spam_check", ptr->name, ptr->value);
 
   return 0;
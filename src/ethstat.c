@@ -48,31 +48,82 @@ struct value_map_s {
 };
 typedef struct value_map_s value_map_t;
 
-static char **interfaces;
-static size_t interfaces_num;
+/* Number of value lists handed to the daemon at once. */
+#define ETHSTAT_DISPATCH_BATCH 64
+
+/* One statistic of an interface, resolved against the value map. */
+typedef struct {
+  char name[ETH_GSTRING_LEN + 1];
+  value_map_t const *map;
+} ethstat_entry_t;
+
+/* The string set of the driver changes rarely, so it is only fetched again
+ * when the driver information changes. */
+typedef struct {
+  char *device;
+  struct ethtool_drvinfo drvinfo;
+
+  ethstat_entry_t *entries;
+  struct ethtool_stats *stats;
+  size_t n_stats;
+} ethstat_interface_t;
+
+/* Shared by the read callbacks of all interfaces. */
+static int ethstat_fd = -1;
 
 static c_avl_tree_t *value_map;
 
 static bool collect_mapped_only;
 
+static int ethstat_read_interface(user_data_t *ud);
+
+static void ethstat_interface_free(void *arg) /* {{{ */
+{
+  ethstat_interface_t *iface = arg;
+
+  if (iface == NULL)
+    return;
+
+  sfree(iface->device);
+  sfree(iface->entries);
+  sfree(iface->stats);
+  sfree(iface);
+} /* }}} void ethstat_interface_free */
+
 static int ethstat_add_interface(const oconfig_item_t *ci) /* {{{ */
 {
-  char **tmp;
+  ethstat_interface_t *iface;
+  char cb_name[DATA_MAX_NAME_LEN];
   int status;
 
-  tmp = realloc(interfaces, sizeof(*interfaces) * (interfaces_num + 1));
-  if (tmp == NULL)
-    return -1;
-  interfaces = tmp;
-  interfaces[interfaces_num] = NULL;
+  iface = calloc(1, sizeof(*iface));
+  if (iface == NULL) {
+    ERROR("ethstat plugin: calloc failed.");
+    return ENOMEM;
+  }
 
-  status = cf_util_get_string(ci, interfaces + interfaces_num);
-  if (status != 0)
+  status = cf_util_get_string(ci, &iface->device);
+  if (status != 0) {
+    sfree(iface);
     return status;
+  }
 
-  interfaces_num++;
-  INFO("ethstat plugin: Registered interface %s",
-       interfaces[interfaces_num - 1]);
+  /* Each interface gets its own read callback, so that interfaces are
+   * queried in parallel by the read threads. */
+  ssnprintf(cb_name, sizeof(cb_name), "ethstat/%s", iface->device);
+  status = plugin_register_complex_read(
+      /* group = */ NULL, cb_name, ethstat_read_interface, /* interval = */ 0,
+      &(user_data_t){
+          .data = iface,
+          .free_func = ethstat_interface_free,
+      });
+  if (status != 0) {
+    ERROR("ethstat plugin: Registering the read callback for %s failed.",
+          iface->device);
+    return status;
+  }
+
+  INFO("ethstat plugin: Registered interface %s", iface->device);
 
   return 0;
 } /* }}} int ethstat_add_interface */
@@ -157,141 +208,198 @@ static int ethstat_config(oconfig_item_t *ci) /* {{{ */
   return 0;
 } /* }}} */
 
-static void ethstat_submit_value(const char *device, const char *type_instance,
-                                 derive_t value) {
+static bool ethstat_drvinfo_equal(struct ethtool_drvinfo const *a, /* {{{ */
+                                  struct ethtool_drvinfo const *b) {
+  return (a->n_stats == b->n_stats) &&
+         (strncmp(a->driver, b->driver, sizeof(a->driver)) == 0) &&
+         (strncmp(a->version, b->version, sizeof(a->version)) == 0) &&
+         (strncmp(a->fw_version, b->fw_version, sizeof(a->fw_version)) == 0) &&
+         (strncmp(a->bus_info, b->bus_info, sizeof(a->bus_info)) == 0);
+} /* }}} bool ethstat_drvinfo_equal */
+
+/* Fetches the string set of the interface and resolves the value map entries.
+ * Also allocates the buffer used for reading the statistics. */
+static int ethstat_update_strings(ethstat_interface_t *iface, /* {{{ */
+                                  struct ethtool_drvinfo const *drvinfo) {
   static c_complain_t complain_no_map = C_COMPLAIN_INIT_STATIC;
 
-  value_list_t vl = VALUE_LIST_INIT;
-  value_map_t *map = NULL;
-
-  if (value_map != NULL)
-    c_avl_get(value_map, type_instance, (void *)&map);
+  size_t n_stats = (size_t)drvinfo->n_stats;
+  struct ethtool_gstrings *strings;
+  ethstat_entry_t *entries;
+  struct ethtool_stats *stats;
 
-  /* If the "MappedOnly" option is specified, ignore unmapped values. */
-  if (collect_mapped_only && (map == NULL)) {
-    if (value_map == NULL)
-      c_complain(
-          LOG_WARNING, &complain_no_map,
-          "ethstat plugin: The \"MappedOnly\" option has been set to true, "
-          "but no mapping has been configured. All values will be ignored!");
-    return;
+  strings = malloc(sizeof(*strings) + (n_stats * ETH_GSTRING_LEN));
+  entries = calloc(n_stats, sizeof(*entries));
+  stats = malloc(sizeof(*stats) + (n_stats * sizeof(uint64_t)));
+  if ((strings == NULL) || (entries == NULL) || (stats == NULL)) {
+    sfree(strings);
+    sfree(entries);
+    sfree(stats);
+    ERROR("ethstat plugin: malloc failed.");
+    return -1;
   }
 
-  vl.values = &(value_t){.derive = value};
-  vl.values_len = 1;
-
-  sstrncpy(vl.plugin, "ethstat", sizeof(vl.plugin));
-  sstrncpy(vl.plugin_instance, device, sizeof(vl.plugin_instance));
-  if (map != NULL) {
-    sstrncpy(vl.type, map->type, sizeof(vl.type));
-    sstrncpy(vl.type_instance, map->type_instance, sizeof(vl.type_instance));
-  } else {
-    sstrncpy(vl.type, "derive", sizeof(vl.type));
-    sstrncpy(vl.type_instance, type_instance, sizeof(vl.type_instance));
+  strings->cmd = ETHTOOL_GSTRINGS;
+  strings->string_set = ETH_SS_STATS;
+  strings->len = n_stats;
+
+  struct ifreq req = {.ifr_data = (void *)strings};
+  sstrncpy(req.ifr_name, iface->device, sizeof(req.ifr_name));
+
+  if (ioctl(ethstat_fd, SIOCETHTOOL, &req) < 0) {
+    ERROR("ethstat plugin: Cannot get strings from %s: %s", iface->device,
+          STRERRNO);
+    sfree(strings);
+    sfree(entries);
+    sfree(stats);
+    return -1;
   }
 
-  plugin_dispatch_values(&vl);
-}
+  if (collect_mapped_only && (value_map == NULL))
+    c_complain(
+        LOG_WARNING, &complain_no_map,
+        "ethstat plugin: The \"MappedOnly\" option has been set to true, "
+        "but no mapping has been configured. All values will be ignored!");
 
-static int ethstat_read_interface(char *device) {
-  int fd;
-  struct ethtool_gstrings *strings;
-  struct ethtool_stats *stats;
-  size_t n_stats;
-  size_t strings_size;
-  size_t stats_size;
-  int status;
+  for (size_t i = 0; i < n_stats; i++) {
+    char *stat_name = (void *)&strings->data[i * ETH_GSTRING_LEN];
+    /* The string is not null-terminated if it fills all of ETH_GSTRING_LEN. */
+    char name[ETH_GSTRING_LEN + 1];
+    memcpy(name, stat_name, ETH_GSTRING_LEN);
+    name[ETH_GSTRING_LEN] = 0;
 
-  fd = socket(AF_INET, SOCK_DGRAM, /* protocol = */ 0);
-  if (fd < 0) {
-    ERROR("ethstat plugin: Failed to open control socket: %s", STRERRNO);
-    return 1;
+    /* Remove leading spaces in key name */
+    stat_name = name;
+    while (isspace((int)*stat_name))
+      stat_name++;
+
+    sstrncpy(entries[i].name, stat_name, sizeof(entries[i].name));
+    if (value_map != NULL)
+      c_avl_get(value_map, entries[i].name, (void *)&entries[i].map);
   }
 
+  sfree(strings);
+
+  sfree(iface->entries);
+  sfree(iface->stats);
+  iface->entries = entries;
+  iface->stats = stats;
+  iface->n_stats = n_stats;
+  memcpy(&iface->drvinfo, drvinfo, sizeof(iface->drvinfo));
+
+  DEBUG("ethstat plugin: Cached %" PRIsz " statistics names of %s.", n_stats,
+        iface->device);
+  return 0;
+} /* }}} int ethstat_update_strings */
+
+static void ethstat_flush(value_list_t *vls, size_t *num) /* {{{ */
+{
+  if (*num == 0)
+    return;
+
+  plugin_dispatch_value_lists(vls, *num);
+  *num = 0;
+} /* }}} void ethstat_flush */
+
+static int ethstat_read_interface(user_data_t *ud) /* {{{ */
+{
+  ethstat_interface_t *iface = ud->data;
+  char *device = iface->device;
+  int status;
+
   struct ethtool_drvinfo drvinfo = {.cmd = ETHTOOL_GDRVINFO};
 
   struct ifreq req = {.ifr_data = (void *)&drvinfo};
 
   sstrncpy(req.ifr_name, device, sizeof(req.ifr_name));
 
-  status = ioctl(fd, SIOCETHTOOL, &req);
+  status = ioctl(ethstat_fd, SIOCETHTOOL, &req);
   if (status < 0) {
-    close(fd);
     ERROR("ethstat plugin: Failed to get driver information "
           "from %s: %s",
           device, STRERRNO);
     return -1;
   }
 
-  n_stats = (size_t)drvinfo.n_stats;
-  if (n_stats < 1) {
-    close(fd);
+  if (drvinfo.n_stats < 1) {
     ERROR("ethstat plugin: No stats available for %s", device);
     return -1;
   }
 
-  strings_size = sizeof(struct ethtool_gstrings) + (n_stats * ETH_GSTRING_LEN);
-  stats_size = sizeof(struct ethtool_stats) + (n_stats * sizeof(uint64_t));
-
-  strings = malloc(strings_size);
-  stats = malloc(stats_size);
-  if ((strings == NULL) || (stats == NULL)) {
-    close(fd);
-    sfree(strings);
-    sfree(stats);
-    ERROR("ethstat plugin: malloc failed.");
-    return -1;
+  if ((iface->entries == NULL) ||
+      !ethstat_drvinfo_equal(&iface->drvinfo, &drvinfo)) {
+    status = ethstat_update_strings(iface, &drvinfo);
+    if (status != 0)
+      return status;
   }
 
-  strings->cmd = ETHTOOL_GSTRINGS;
-  strings->string_set = ETH_SS_STATS;
-  strings->len = n_stats;
-  req.ifr_data = (void *)strings;
-  status = ioctl(fd, SIOCETHTOOL, &req);
-  if (status < 0) {
-    close(fd);
-    free(strings);
-    free(stats);
-    ERROR("ethstat plugin: Cannot get strings from %s: %s", device, STRERRNO);
-    return -1;
-  }
-
-  stats->cmd = ETHTOOL_GSTATS;
-  stats->n_stats = n_stats;
-  req.ifr_data = (void *)stats;
-  status = ioctl(fd, SIOCETHTOOL, &req);
+  iface->stats->cmd = ETHTOOL_GSTATS;
+  iface->stats->n_stats = iface->n_stats;
+  req.ifr_data = (void *)iface->stats;
+  status = ioctl(ethstat_fd, SIOCETHTOOL, &req);
   if (status < 0) {
-    close(fd);
-    free(strings);
-    free(stats);
     ERROR("ethstat plugin: Reading statistics from %s failed: %s", device,
           STRERRNO);
     return -1;
   }
 
-  for (size_t i = 0; i < n_stats; i++) {
-    char *stat_name;
+  /* The number of statistics changed between the two calls. Only the
+   * statistics we know the names of are used; they will be updated on the
+   * next read. */
+  size_t n_stats = iface->n_stats;
+  if ((size_t)iface->stats->n_stats < n_stats)
+    n_stats = (size_t)iface->stats->n_stats;
 
-    stat_name = (void *)&strings->data[i * ETH_GSTRING_LEN];
-    /* Remove leading spaces in key name */
-    while (isspace((int)*stat_name))
-      stat_name++;
+  value_list_t vls[ETHSTAT_DISPATCH_BATCH];
+  value_t values[ETHSTAT_DISPATCH_BATCH];
+  size_t num = 0;
 
-    DEBUG("ethstat plugin: device = \"%s\": %s = %" PRIu64, device, stat_name,
-          (uint64_t)stats->data[i]);
-    ethstat_submit_value(device, stat_name, (derive_t)stats->data[i]);
-  }
+  for (size_t i = 0; i < n_stats; i++) {
+    ethstat_entry_t const *e = iface->entries + i;
+
+    /* If the "MappedOnly" option is specified, ignore unmapped values. */
+    if (collect_mapped_only && (e->map == NULL))
+      continue;
+
+    DEBUG("ethstat plugin: device = \"%s\": %s = %" PRIu64, device, e->name,
+          (uint64_t)iface->stats->data[i]);
+
+    value_list_t *vl = vls + num;
+    values[num].derive = (derive_t)iface->stats->data[i];
+
+    *vl = (value_list_t)VALUE_LIST_INIT;
+    vl->values = values + num;
+    vl->values_len = 1;
+
+    sstrncpy(vl->plugin, "ethstat", sizeof(vl->plugin));
+    sstrncpy(vl->plugin_instance, device, sizeof(vl->plugin_instance));
+    if (e->map != NULL) {
+      sstrncpy(vl->type, e->map->type, sizeof(vl->type));
+      sstrncpy(vl->type_instance, e->map->type_instance,
+               sizeof(vl->type_instance));
+    } else {
+      sstrncpy(vl->type, "derive", sizeof(vl->type));
+      sstrncpy(vl->type_instance, e->name, sizeof(vl->type_instance));
+    }
 
-  close(fd);
-  sfree(strings);
-  sfree(stats);
+    num++;
+    if (num == ETHSTAT_DISPATCH_BATCH)
+      ethstat_flush(vls, &num);
+  }
+  ethstat_flush(vls, &num);
 
   return 0;
 } /* }}} ethstat_read_interface */
 
-static int ethstat_read(void) {
-  for (size_t i = 0; i < interfaces_num; i++)
-    ethstat_read_interface(interfaces[i]);
+static int ethstat_init(void) {
+  if (ethstat_fd >= 0)
+    return 0;
+
+  ethstat_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, /* protocol = */ 0);
+  if (ethstat_fd < 0) {
+    ERROR("ethstat plugin: Failed to open control socket: %s", STRERRNO);
+    return -1;
+  }
 
   return 0;
 }
@@ -300,6 +408,11 @@ static int ethstat_shutdown(void) {
   void *key = NULL;
   void *value = NULL;
 
+  if (ethstat_fd >= 0) {
+    close(ethstat_fd);
+    ethstat_fd = -1;
+  }
+
   if (value_map == NULL)
     return 0;
 
@@ -316,6 +429,6 @@ static int ethstat_shutdown(void) {
 
 void module_register(void) {
   plugin_register_complex_config("ethstat", ethstat_config);
-  plugin_register_read("ethstat", ethstat_read);
+  plugin_register_init("ethstat", ethstat_init);
   plugin_register_shutdown("ethstat", ethstat_shutdown);
 }
@@ -36,6 +36,7 @@
 
 #include "utils/cmds/putnotif.h"
 #include "utils/cmds/putval.h"
+#include "utils_complain.h"
 
 #include <grp.h>
 #include <poll.h>
@@ -51,9 +52,18 @@ extern char **environ;
 
 #define PL_NORMAL 0x01
 #define PL_NOTIF_ACTION 0x02
+#define PL_NOTIF_PERSIST 0x04
 
 #define PL_RUNNING 0x10
 
+/* Number of value lists of a "PUTVALS" block collected before they are
+ * dispatched in one go. */
+#define EXEC_BULK_SIZE 128
+
+/* Number of notifications queued for a persistent notification program before
+ * new ones are dropped. */
+#define EXEC_NOTIF_QUEUE_LIMIT 1024
+
 /*
  * Private data types
  */
@@ -64,7 +74,12 @@ extern char **environ;
  * The `pid' and `status' fields are thus unused if the `PL_NOTIF_ACTION' flag
  * is set.
  * The `PL_RUNNING' flag is set in `exec_read' and unset in `exec_read_one'.
+ * Programs with the `PL_NOTIF_PERSIST' flag are owned by their worker thread,
+ * which is the only one to write `pid' and `status'.
  */
+struct exec_notif_worker_s;
+typedef struct exec_notif_worker_s exec_notif_worker_t;
+
 struct program_list_s;
 typedef struct program_list_s program_list_t;
 struct program_list_s {
@@ -75,6 +90,7 @@ struct program_list_s {
   int pid;
   int status;
   int flags;
+  exec_notif_worker_t *worker;
   program_list_t *next;
 };
 
@@ -83,6 +99,39 @@ typedef struct program_list_and_notification_s {
   notification_t n;
 } program_list_and_notification_t;
 
+/*
+ * Notifications waiting to be written to a persistent notification program.
+ */
+typedef struct exec_notif_entry_s {
+  notification_t n;
+  struct exec_notif_entry_s *next;
+} exec_notif_entry_t;
+
+struct exec_notif_worker_s {
+  pthread_t thread;
+  bool thread_running;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  exec_notif_entry_t *head;
+  exec_notif_entry_t *tail;
+  size_t queue_length;
+  bool shutdown;
+  c_complain_t complaint;
+};
+
+/*
+ * State of a "PUTVALS" block: The identifier is parsed once into `vl' and the
+ * following value lines are collected in `vls' and dispatched together.
+ */
+typedef struct exec_bulk_s {
+  value_list_t vl;
+  const data_set_t *ds;
+  value_list_t vls[EXEC_BULK_SIZE];
+  value_t *values;
+  size_t values_size;
+  size_t num;
+} exec_bulk_t;
+
 /*
  * constants
  */
@@ -143,6 +192,8 @@ static int exec_config_exec(oconfig_item_t *ci) /* {{{ */
 
   if (strcasecmp("NotificationExec", ci->key) == 0)
     pl->flags |= PL_NOTIF_ACTION;
+  else if (strcasecmp("PersistentNotificationExec", ci->key) == 0)
+    pl->flags |= PL_NOTIF_ACTION | PL_NOTIF_PERSIST;
   else
     pl->flags |= PL_NORMAL;
 
@@ -241,7 +292,8 @@ static int exec_config(oconfig_item_t *ci) /* {{{ */
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
     if ((strcasecmp("Exec", child->key) == 0) ||
-        (strcasecmp("NotificationExec", child->key) == 0))
+        (strcasecmp("NotificationExec", child->key) == 0) ||
+        (strcasecmp("PersistentNotificationExec", child->key) == 0))
       exec_config_exec(child);
     else {
       WARNING("exec plugin: Unknown config option `%s'.", child->key);
@@ -554,12 +606,147 @@ failed:
   return -1;
 } /* int fork_child }}} */
 
-static int parse_line(char *buffer) /* {{{ */
+static void exec_bulk_flush(exec_bulk_t *bulk) /* {{{ */
+{
+  if (bulk->num == 0)
+    return;
+
+  int failed = plugin_dispatch_value_lists(bulk->vls, bulk->num);
+  if (failed != 0)
+    WARNING("exec plugin: Dispatching %d of %" PRIsz " value lists failed.",
+            failed, bulk->num);
+
+  bulk->num = 0;
+} /* }}} void exec_bulk_flush */
+
+static void exec_bulk_end(exec_bulk_t *bulk) /* {{{ */
+{
+  exec_bulk_flush(bulk);
+  bulk->ds = NULL;
+} /* }}} void exec_bulk_end */
+
+/* Handles "PUTVALS <Identifier> [interval=<seconds>]", which starts a block of
+ * value lines for this identifier. */
+static int exec_bulk_begin(exec_bulk_t *bulk, char *buffer) /* {{{ */
+{
+  char *fields[4];
+  char *identifier;
+  size_t identifier_len;
+  value_list_t vl = VALUE_LIST_INIT;
+
+  exec_bulk_end(bulk);
+
+  int fields_num = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
+  if ((fields_num < 2) || (fields_num > 3)) {
+    ERROR("exec plugin: PUTVALS expects an identifier and an optional "
+          "interval, got %d fields.",
+          fields_num - 1);
+    return -1;
+  }
+
+  identifier = fields[1];
+  identifier_len = strlen(identifier);
+  if ((identifier_len >= 2) && (identifier[0] == '"') &&
+      (identifier[identifier_len - 1] == '"')) {
+    identifier[identifier_len - 1] = 0;
+    identifier++;
+  }
+
+  if (parse_identifier_vl(identifier, &vl) != 0) {
+    ERROR("exec plugin: PUTVALS: Cannot parse identifier `%s'.", identifier);
+    return -1;
+  }
+
+  if (fields_num == 3) {
+    char *key = NULL;
+    char *value = NULL;
+    char *endptr = NULL;
+    double interval;
+
+    if ((cmd_parse_option(fields[2], &key, &value, NULL) != CMD_OK) ||
+        (strcasecmp("interval", key) != 0)) {
+      ERROR("exec plugin: PUTVALS: Unknown option `%s'.", fields[2]);
+      return -1;
+    }
+
+    errno = 0;
+    interval = strtod(value, &endptr);
+    if ((errno != 0) || (endptr == value) || (*endptr != 0) ||
+        (interval <= 0.0)) {
+      ERROR("exec plugin: PUTVALS: Invalid interval `%s'.", value);
+      return -1;
+    }
+    vl.interval = DOUBLE_TO_CDTIME_T(interval);
+  }
+
+  const data_set_t *ds = plugin_get_ds(vl.type);
+  if (ds == NULL) {
+    ERROR("exec plugin: PUTVALS: Type `%s' isn't defined.", vl.type);
+    return -1;
+  }
+
+  size_t values_size = EXEC_BULK_SIZE * ds->ds_num;
+  if (bulk->values_size < values_size) {
+    value_t *tmp = realloc(bulk->values, values_size * sizeof(*bulk->values));
+    if (tmp == NULL) {
+      ERROR("exec plugin: realloc failed.");
+      return -1;
+    }
+    bulk->values = tmp;
+    bulk->values_size = values_size;
+  }
+
+  bulk->vl = vl;
+  bulk->ds = ds;
+  return 0;
+} /* }}} int exec_bulk_begin */
+
+/* Handles one "<time>:<value>[:<value>...]" line of a "PUTVALS" block. */
+static int exec_bulk_value(exec_bulk_t *bulk, char *buffer) /* {{{ */
+{
+  value_list_t *vl = bulk->vls + bulk->num;
+
+  *vl = bulk->vl;
+  vl->values = bulk->values + bulk->num * bulk->ds->ds_num;
+  vl->values_len = bulk->ds->ds_num;
+
+  if (parse_values(buffer, vl, bulk->ds) != 0) {
+    ERROR("exec plugin: PUTVALS: Unable to parse value line \"%s\" for "
+          "type `%s'.",
+          buffer, bulk->ds->type);
+    return -1;
+  }
+
+  bulk->num++;
+  if (bulk->num >= EXEC_BULK_SIZE)
+    exec_bulk_flush(bulk);
+
+  return 0;
+} /* }}} int exec_bulk_value */
+
+static bool exec_is_value_line(const char *buffer) /* {{{ */
+{
+  if (isdigit((unsigned char)buffer[0]))
+    return true;
+  return (buffer[0] == 'N') && (buffer[1] == ':');
+} /* }}} bool exec_is_value_line */
+
+static int parse_line(exec_bulk_t *bulk, char *buffer) /* {{{ */
 {
-  if (strncasecmp("PUTVAL", buffer, strlen("PUTVAL")) == 0)
+  if ((bulk->ds != NULL) && exec_is_value_line(buffer))
+    return exec_bulk_value(bulk, buffer);
+
+  /* Any other line ends a "PUTVALS" block. */
+  exec_bulk_end(bulk);
+
+  if (strncasecmp("PUTVALS", buffer, strlen("PUTVALS")) == 0)
+    return exec_bulk_begin(bulk, buffer);
+  else if (strncasecmp("PUTVAL", buffer, strlen("PUTVAL")) == 0)
     return cmd_handle_putval(stdout, buffer);
   else if (strncasecmp("PUTNOTIF", buffer, strlen("PUTNOTIF")) == 0)
     return handle_putnotif(stdout, buffer);
+  else if (buffer[0] == 0)
+    return 0;
   else {
     ERROR("exec plugin: Unable to parse command, ignoring line: \"%s\"",
           buffer);
@@ -573,13 +760,21 @@ static void *exec_read_one(void *arg) /* {{{ */
   int fd, fd_err;
   struct pollfd fds[2] = {{0}};
   int status;
-  char buffer[1200]; /* if not completely read */
+  char buffer[4096]; /* if not completely read */
   char buffer_err[1024];
   char *pbuffer = buffer;
   char *pbuffer_err = buffer_err;
+  exec_bulk_t *bulk;
 
-  status = fork_child(pl, NULL, &fd, &fd_err);
+  bulk = calloc(1, sizeof(*bulk));
+  if (bulk == NULL) {
+    ERROR("exec plugin: calloc failed.");
+    status = -1;
+  } else {
+    status = fork_child(pl, NULL, &fd, &fd_err);
+  }
   if (status < 0) {
+    sfree(bulk);
     /* Reset the "running" flag */
     pthread_mutex_lock(&pl_lock);
     pl->flags &= ~PL_RUNNING;
@@ -624,13 +819,16 @@ static void *exec_read_one(void *arg) /* {{{ */
 
       while ((pnl = strchr(pbuffer, '\n'))) {
         *pnl = '\0';
-        if (*(pnl - 1) == '\r')
+        if ((pnl > pbuffer) && (*(pnl - 1) == '\r'))
           *(pnl - 1) = '\0';
 
-        parse_line(pbuffer);
+        parse_line(bulk, pbuffer);
 
         pbuffer = ++pnl;
       }
+      /* Dispatch the values of this read instead of waiting for the next
+       * write of the program. */
+      exec_bulk_flush(bulk);
       /* not completely read ? */
       if (pbuffer - buffer < len) {
         len -= pbuffer - buffer;
@@ -696,6 +894,10 @@ static void *exec_read_one(void *arg) /* {{{ */
     }
   }
 
+  exec_bulk_end(bulk);
+  sfree(bulk->values);
+  sfree(bulk);
+
   DEBUG("exec plugin: exec_read_one: Waiting for `%s' to exit.", pl->exec);
   if (waitpid(pl->pid, &status, 0) > 0)
     pl->status = status;
@@ -717,31 +919,14 @@ static void *exec_read_one(void *arg) /* {{{ */
   return NULL;
 } /* void *exec_read_one }}} */
 
-static void *exec_notification_one(void *arg) /* {{{ */
+/* Writes the notification in the format documented in collectd-exec(5). If
+ * `single_line' is true, newlines in the message are replaced by spaces so
+ * that an empty line reliably ends the notification. */
+static void exec_notification_print(FILE *fh, const notification_t *n,
+                                    bool single_line) /* {{{ */
 {
-  program_list_t *pl = ((program_list_and_notification_t *)arg)->pl;
-  notification_t *n = &((program_list_and_notification_t *)arg)->n;
-  int fd;
-  FILE *fh;
-  int pid;
-  int status;
   const char *severity;
 
-  pid = fork_child(pl, &fd, NULL, NULL);
-  if (pid < 0) {
-    sfree(arg);
-    pthread_exit((void *)1);
-  }
-
-  fh = fdopen(fd, "w");
-  if (fh == NULL) {
-    ERROR("exec plugin: fdopen (%i) failed: %s", fd, STRERRNO);
-    kill(pid, SIGTERM);
-    close(fd);
-    sfree(arg);
-    pthread_exit((void *)1);
-  }
-
   severity = "FAILURE";
   if (n->severity == NOTIF_WARNING)
     severity = "WARNING";
@@ -781,7 +966,42 @@ static void *exec_notification_one(void *arg) /* {{{ */
               meta->nm_value.nm_boolean ? "true" : "false");
   }
 
-  fprintf(fh, "\n%s\n", n->message);
+  if (!single_line) {
+    fprintf(fh, "\n%s\n", n->message);
+    return;
+  }
+
+  fputc('\n', fh);
+  for (const char *ptr = n->message; *ptr != 0; ptr++)
+    fputc(((*ptr == '\n') || (*ptr == '\r')) ? ' ' : *ptr, fh);
+  fputs("\n\n", fh);
+} /* }}} void exec_notification_print */
+
+static void *exec_notification_one(void *arg) /* {{{ */
+{
+  program_list_t *pl = ((program_list_and_notification_t *)arg)->pl;
+  notification_t *n = &((program_list_and_notification_t *)arg)->n;
+  int fd;
+  FILE *fh;
+  int pid;
+  int status;
+
+  pid = fork_child(pl, &fd, NULL, NULL);
+  if (pid < 0) {
+    sfree(arg);
+    pthread_exit((void *)1);
+  }
+
+  fh = fdopen(fd, "w");
+  if (fh == NULL) {
+    ERROR("exec plugin: fdopen (%i) failed: %s", fd, STRERRNO);
+    kill(pid, SIGTERM);
+    close(fd);
+    sfree(arg);
+    pthread_exit((void *)1);
+  }
+
+  exec_notification_print(fh, n, /* single_line = */ false);
 
   fflush(fh);
   fclose(fh);
@@ -798,6 +1018,183 @@ static void *exec_notification_one(void *arg) /* {{{ */
   return NULL;
 } /* void *exec_notification_one }}} */
 
+/* Starts the persistent notification program. Returns a handle for its STDIN
+ * or NULL on failure. */
+static FILE *exec_notification_spawn(program_list_t *pl) /* {{{ */
+{
+  int fd;
+  FILE *fh;
+
+  int pid = fork_child(pl, &fd, NULL, NULL);
+  if (pid < 0)
+    return NULL;
+
+  fh = fdopen(fd, "w");
+  if (fh == NULL) {
+    ERROR("exec plugin: fdopen (%i) failed: %s", fd, STRERRNO);
+    kill(pid, SIGTERM);
+    close(fd);
+    waitpid(pid, NULL, 0);
+    return NULL;
+  }
+
+  pl->pid = pid;
+  DEBUG("exec plugin: Started persistent notification program `%s' (pid %i).",
+        pl->exec, pid);
+  return fh;
+} /* }}} FILE *exec_notification_spawn */
+
+/* Closes the program's STDIN and waits up to one second for it to exit before
+ * sending SIGTERM. */
+static void exec_notification_reap(program_list_t *pl, FILE *fh) /* {{{ */
+{
+  int status;
+
+  fclose(fh);
+
+  for (int i = 0; i < 10; i++) {
+    pid_t pid = waitpid(pl->pid, &status, WNOHANG);
+    /* ECHILD: The SIGCHLD handler already collected the child. */
+    if ((pid == pl->pid) || ((pid < 0) && (errno != EINTR))) {
+      pl->pid = 0;
+      return;
+    }
+    usleep(100000);
+  }
+
+  kill(pl->pid, SIGTERM);
+  INFO("exec plugin: Sent SIGTERM to %hu", (unsigned short int)pl->pid);
+  waitpid(pl->pid, &status, 0);
+  pl->pid = 0;
+} /* }}} void exec_notification_reap */
+
+/* Writes the queued notifications to the STDIN of a long-lived program,
+ * restarting it if it went away. */
+static void *exec_notification_worker(void *arg) /* {{{ */
+{
+  program_list_t *pl = arg;
+  exec_notif_worker_t *w = pl->worker;
+  FILE *fh = NULL;
+
+  pthread_mutex_lock(&w->lock);
+  while (true) {
+    while (!w->shutdown && (w->head == NULL))
+      pthread_cond_wait(&w->cond, &w->lock);
+
+    /* Shutting down and the queue is drained. */
+    if (w->head == NULL)
+      break;
+
+    exec_notif_entry_t *e = w->head;
+    w->head = e->next;
+    if (w->head == NULL)
+      w->tail = NULL;
+    w->queue_length--;
+    pthread_mutex_unlock(&w->lock);
+
+    /* A write to a program that has exited fails only once the pipe is
+     * closed, so retry once with a new instance. */
+    for (int attempt = 0; attempt < 2; attempt++) {
+      if (fh == NULL)
+        fh = exec_notification_spawn(pl);
+      if (fh == NULL)
+        break;
+
+      exec_notification_print(fh, &e->n, /* single_line = */ true);
+      if (fflush(fh) == 0)
+        break;
+
+      WARNING("exec plugin: Writing to `%s' failed: %s. Restarting it.",
+              pl->exec, STRERRNO);
+      exec_notification_reap(pl, fh);
+      fh = NULL;
+    }
+
+    if (e->n.meta != NULL)
+      plugin_notification_meta_free(e->n.meta);
+    sfree(e);
+
+    pthread_mutex_lock(&w->lock);
+  }
+  pthread_mutex_unlock(&w->lock);
+
+  if (fh != NULL)
+    exec_notification_reap(pl, fh);
+
+  return NULL;
+} /* }}} void *exec_notification_worker */
+
+static int exec_notification_enqueue(program_list_t *pl, /* {{{ */
+                                     const notification_t *n) {
+  exec_notif_worker_t *w = pl->worker;
+  exec_notif_entry_t *e;
+
+  pthread_mutex_lock(&w->lock);
+  if (w->shutdown || (w->queue_length >= EXEC_NOTIF_QUEUE_LIMIT)) {
+    pthread_mutex_unlock(&w->lock);
+    c_complain(LOG_WARNING, &w->complaint,
+               "exec plugin: The queue of `%s' is full, dropping "
+               "notifications.",
+               pl->exec);
+    return ENOBUFS;
+  }
+  pthread_mutex_unlock(&w->lock);
+
+  e = calloc(1, sizeof(*e));
+  if (e == NULL) {
+    ERROR("exec plugin: calloc failed.");
+    return ENOMEM;
+  }
+
+  memcpy(&e->n, n, sizeof(e->n));
+  /* See exec_notification() */
+  e->n.meta = NULL;
+  plugin_notification_meta_copy(&e->n, n);
+
+  pthread_mutex_lock(&w->lock);
+  if (w->tail == NULL)
+    w->head = e;
+  else
+    w->tail->next = e;
+  w->tail = e;
+  w->queue_length++;
+  pthread_cond_signal(&w->cond);
+  pthread_mutex_unlock(&w->lock);
+
+  c_release(LOG_INFO, &w->complaint,
+            "exec plugin: Queueing notifications for `%s' again.", pl->exec);
+  return 0;
+} /* }}} int exec_notification_enqueue */
+
+static void exec_notification_worker_destroy(program_list_t *pl) /* {{{ */
+{
+  exec_notif_worker_t *w = pl->worker;
+
+  if (w == NULL)
+    return;
+
+  if (w->thread_running) {
+    pthread_mutex_lock(&w->lock);
+    w->shutdown = true;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+
+    pthread_join(w->thread, NULL);
+  }
+
+  while (w->head != NULL) {
+    exec_notif_entry_t *next = w->head->next;
+    if (w->head->n.meta != NULL)
+      plugin_notification_meta_free(w->head->n.meta);
+    sfree(w->head);
+    w->head = next;
+  }
+
+  pthread_cond_destroy(&w->cond);
+  pthread_mutex_destroy(&w->lock);
+  sfree(pl->worker);
+} /* }}} void exec_notification_worker_destroy */
+
 static int exec_init(void) /* {{{ */
 {
   struct sigaction sa = {.sa_handler = sigchld_handler};
@@ -821,6 +1218,30 @@ static int exec_init(void) /* {{{ */
   }
 #endif
 
+  for (program_list_t *pl = pl_head; pl != NULL; pl = pl->next) {
+    if (((pl->flags & PL_NOTIF_PERSIST) == 0) || (pl->worker != NULL))
+      continue;
+
+    pl->worker = calloc(1, sizeof(*pl->worker));
+    if (pl->worker == NULL) {
+      ERROR("exec plugin: calloc failed.");
+      continue;
+    }
+    pthread_mutex_init(&pl->worker->lock, NULL);
+    pthread_cond_init(&pl->worker->cond, NULL);
+    C_COMPLAIN_INIT(&pl->worker->complaint);
+
+    int status = plugin_thread_create(&pl->worker->thread,
+                                      exec_notification_worker, pl,
+                                      "exec notif");
+    if (status != 0) {
+      ERROR("exec plugin: plugin_thread_create failed.");
+      exec_notification_worker_destroy(pl);
+      continue;
+    }
+    pl->worker->thread_running = true;
+  }
+
   return 0;
 } /* int exec_init }}} */
 
@@ -865,6 +1286,13 @@ static int exec_notification(const notification_t *n, /* {{{ */
     if ((pl->flags & PL_NOTIF_ACTION) == 0)
       continue;
 
+    /* Long-lived programs are fed by their worker thread. */
+    if ((pl->flags & PL_NOTIF_PERSIST) != 0) {
+      if (pl->worker != NULL)
+        exec_notification_enqueue(pl, n);
+      continue;
+    }
+
     /* Skip if a child is already running. */
     if (pl->pid != 0)
       continue;
@@ -904,6 +1332,9 @@ static int exec_shutdown(void) /* {{{ */
   while (pl != NULL) {
     next = pl->next;
 
+    /* Delivers the pending notifications and closes the program's STDIN. */
+    exec_notification_worker_destroy(pl);
+
     if (pl->pid > 0) {
       kill(pl->pid, SIGTERM);
       INFO("exec plugin: Sent SIGTERM to %hu", (unsigned short int)pl->pid);
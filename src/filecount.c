@@ -24,7 +24,9 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
+#include "utils_complain.h"
 
 #include <dirent.h>
 #include <fcntl.h>
@@ -32,10 +34,42 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#if HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
 #define FC_RECURSIVE 1
 #define FC_HIDDEN 2
 #define FC_REGULAR 4
 
+/*
+ * Incremental mode
+ *
+ * The directory is scanned once. Every (sub-)directory gets an inotify watch
+ * and remembers the files it counted, so later reads only have to apply the
+ * changes reported by the kernel. The tree is scanned again after
+ * "RescanInterval", after the event queue overflowed and on every read while
+ * watches cannot be added.
+ */
+#define FC_INOTIFY_MASK                                                        \
+  (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE |      \
+   IN_MODIFY | IN_DELETE_SELF | IN_MOVE_SELF)
+
+/* A file that has been counted; the name is the key in fc_node_t.files. */
+typedef struct {
+  uint64_t size;
+  char name[];
+} fc_file_t;
+
+typedef struct fc_node_s fc_node_t;
+struct fc_node_s {
+  char *path;
+  char *name; /* points into path */
+  int wd;
+  c_avl_tree_t *files;   /* name -> fc_file_t */
+  c_avl_tree_t *subdirs; /* name -> fc_node_t */
+};
+
 struct fc_directory_conf_s {
   char *path;
   char *plugin_name;
@@ -57,13 +91,27 @@ struct fc_directory_conf_s {
 
   /* Helper for the recursive functions */
   time_t now;
+
+  /* Incremental mode */
+  bool incremental;
+  cdtime_t rescan_interval;
+  cdtime_t last_scan;
+  bool rescan;
+  int inotify_fd;
+  fc_node_t *root;
+  c_avl_tree_t *nodes_by_wd;
+  c_complain_t watch_complaint;
 };
 typedef struct fc_directory_conf_s fc_directory_conf_t;
 
 static fc_directory_conf_t **directories;
 static size_t directories_num;
 
+static void fc_tree_destroy(fc_directory_conf_t *dir);
+
 static void fc_free_dir(fc_directory_conf_t *dir) {
+  fc_tree_destroy(dir);
+
   sfree(dir->path);
   sfree(dir->plugin_name);
   sfree(dir->instance);
@@ -113,6 +161,8 @@ static void fc_submit_dir(const fc_directory_conf_t *dir) {
  *     FilesSizeType "bytes"
  *     FilesCountType "files"
  *     TypeInstance "instance"
+ *     Incremental false
+ *     RescanInterval 3600
  *   </Directory>
  * </Plugin>
  *
@@ -313,6 +363,7 @@ static int fc_config_add_dir(oconfig_item_t *ci) {
     ERROR("filecount plugin: calloc failed.");
     return -1;
   }
+  dir->inotify_fd = -1;
 
   dir->path = strdup(ci->values[0].value.string);
   if (dir->path == NULL) {
@@ -333,6 +384,9 @@ static int fc_config_add_dir(oconfig_item_t *ci) {
   dir->files_size_type = strdup("bytes");
   dir->files_num_type = strdup("files");
 
+  dir->rescan_interval = TIME_T_TO_CDTIME_T(3600);
+  C_COMPLAIN_INIT(&dir->watch_complaint);
+
   if (dir->plugin_name == NULL || dir->files_size_type == NULL ||
       dir->files_num_type == NULL) {
     ERROR("filecount plugin: strdup failed.");
@@ -366,6 +420,10 @@ static int fc_config_add_dir(oconfig_item_t *ci) {
       status = cf_util_get_string(option, &dir->files_num_type);
     else if (strcasecmp("TypeInstance", option->key) == 0)
       status = cf_util_get_string(option, &dir->type_instance);
+    else if (strcasecmp("Incremental", option->key) == 0)
+      status = cf_util_get_boolean(option, &dir->incremental);
+    else if (strcasecmp("RescanInterval", option->key) == 0)
+      status = cf_util_get_cdtime(option, &dir->rescan_interval);
     else {
       WARNING("filecount plugin: fc_config_add_dir: "
               "Option `%s' not allowed here.",
@@ -410,6 +468,23 @@ static int fc_config_add_dir(oconfig_item_t *ci) {
     return -1;
   }
 
+#if HAVE_SYS_INOTIFY_H
+  /* Whether a file matches "MTime" changes without any event. */
+  if (dir->incremental && (dir->mtime != 0)) {
+    WARNING("filecount plugin: `Incremental' cannot be combined with "
+            "`MTime'. Scanning '%s' on every read.",
+            dir->path);
+    dir->incremental = false;
+  }
+#else
+  if (dir->incremental) {
+    WARNING("filecount plugin: `Incremental' requires inotify, which is not "
+            "available on this system. Scanning '%s' on every read.",
+            dir->path);
+    dir->incremental = false;
+  }
+#endif
+
   /* Ready to add it to list */
   fc_directory_conf_t **temp =
       realloc(directories, sizeof(*directories) * (directories_num + 1));
@@ -449,42 +524,20 @@ static int fc_init(void) {
   return 0;
 } /* int fc_init */
 
-static int fc_read_dir_callback(const char *dirname, const char *filename,
-                                void *user_data) {
-  fc_directory_conf_t *dir = user_data;
-  char abs_path[PATH_MAX];
-  struct stat statbuf;
-
-  if (dir == NULL)
-    return -1;
-
-  snprintf(abs_path, sizeof(abs_path), "%s/%s", dirname, filename);
-
-  int status = lstat(abs_path, &statbuf);
-  if (status != 0) {
-    ERROR("filecount plugin: stat (%s) failed.", abs_path);
-    return -1;
-  }
-
-  if (S_ISDIR(statbuf.st_mode) && (dir->options & FC_RECURSIVE)) {
-    status = walk_directory(
-        abs_path, fc_read_dir_callback, dir,
-        /* include hidden = */ (dir->options & FC_HIDDEN) ? 1 : 0);
-    return status;
-  } else if ((dir->options & FC_REGULAR) && !S_ISREG(statbuf.st_mode)) {
-    return 0;
-  }
+/* Returns true if the file "name" is counted. */
+static bool fc_match(fc_directory_conf_t const *dir, char const *name,
+                     struct stat const *statbuf) {
+  if ((dir->options & FC_REGULAR) && !S_ISREG(statbuf->st_mode))
+    return false;
 
   if (dir->name != NULL) {
-    status = fnmatch(dir->name, filename, /* flags = */ 0);
+    int status = fnmatch(dir->name, name, /* flags = */ 0);
     if (status != 0)
-      return 0;
+      return false;
   }
 
-  if (!S_ISREG(statbuf.st_mode)) {
-    dir->files_num++;
-    return 0;
-  }
+  if (!S_ISREG(statbuf->st_mode))
+    return true;
 
   if (dir->mtime != 0) {
     time_t mtime = dir->now;
@@ -497,9 +550,9 @@ static int fc_read_dir_callback(const char *dirname, const char *filename,
     DEBUG("filecount plugin: Only collecting files that were touched %s %u.",
           (dir->mtime < 0) ? "after" : "before", (unsigned int)mtime);
 
-    if (((dir->mtime < 0) && (statbuf.st_mtime < mtime)) ||
-        ((dir->mtime > 0) && (statbuf.st_mtime > mtime)))
-      return 0;
+    if (((dir->mtime < 0) && (statbuf->st_mtime < mtime)) ||
+        ((dir->mtime > 0) && (statbuf->st_mtime > mtime)))
+      return false;
   }
 
   if (dir->size != 0) {
@@ -510,29 +563,416 @@ static int fc_read_dir_callback(const char *dirname, const char *filename,
     else
       size = (off_t)dir->size;
 
-    if (((dir->size < 0) && (statbuf.st_size > size)) ||
-        ((dir->size > 0) && (statbuf.st_size < size)))
-      return 0;
+    if (((dir->size < 0) && (statbuf->st_size > size)) ||
+        ((dir->size > 0) && (statbuf->st_size < size)))
+      return false;
+  }
+
+  return true;
+} /* bool fc_match */
+
+static bool fc_skip_name(fc_directory_conf_t const *dir, char const *name) {
+  if ((strcmp(".", name) == 0) || (strcmp("..", name) == 0))
+    return true;
+  if (!(dir->options & FC_HIDDEN) && (name[0] == '.'))
+    return true;
+  return false;
+} /* bool fc_skip_name */
+
+/* Counts "name" if it matches and remembers it in "node", if given. */
+static void fc_entry_add(fc_directory_conf_t *dir, fc_node_t *node,
+                         char const *name, struct stat const *statbuf) {
+  if (!fc_match(dir, name, statbuf))
+    return;
+
+  uint64_t size = S_ISREG(statbuf->st_mode) ? (uint64_t)statbuf->st_size : 0;
+
+  if (node != NULL) {
+    size_t name_len = strlen(name);
+    fc_file_t *f = malloc(sizeof(*f) + name_len + 1);
+    if (f == NULL)
+      return;
+    f->size = size;
+    memcpy(f->name, name, name_len + 1);
+    if (c_avl_insert(node->files, f->name, f) != 0) {
+      sfree(f);
+      return;
+    }
   }
 
   dir->files_num++;
-  dir->files_size += (uint64_t)statbuf.st_size;
+  dir->files_size += size;
+} /* void fc_entry_add */
+
+static fc_node_t *fc_node_add(fc_directory_conf_t *dir, fc_node_t *parent,
+                              char const *name);
+
+/* Reads the directory "path" with getdents(2) and stats its entries relative
+ * to the directory's descriptor, so that the kernel does not have to resolve
+ * the full path of every file. */
+static int fc_scan(fc_directory_conf_t *dir, fc_node_t *node,
+                   char const *path) /* {{{ */
+{
+  int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    ERROR("filecount plugin: Cannot open '%s': %s", path, STRERRNO);
+    return -1;
+  }
+
+  DIR *dh = fdopendir(fd);
+  if (dh == NULL) {
+    ERROR("filecount plugin: fdopendir (%s) failed: %s", path, STRERRNO);
+    close(fd);
+    return -1;
+  }
+
+  struct dirent *ent;
+  while ((ent = readdir(dh)) != NULL) {
+    bool recursive = (dir->options & FC_RECURSIVE) != 0;
+    struct stat statbuf;
+
+    if (fc_skip_name(dir, ent->d_name))
+      continue;
+
+    /* Skip entries that cannot match without calling stat(2). */
+    if ((dir->options & FC_REGULAR) && (ent->d_type != DT_UNKNOWN) &&
+        (ent->d_type != DT_REG) && !(recursive && (ent->d_type == DT_DIR)))
+      continue;
+
+    if (!recursive || (ent->d_type != DT_DIR)) {
+      if (fstatat(fd, ent->d_name, &statbuf, AT_SYMLINK_NOFOLLOW) != 0) {
+        /* Removed since readdir(3) returned it. */
+        DEBUG("filecount plugin: stat (%s/%s) failed: %s", path, ent->d_name,
+              STRERRNO);
+        continue;
+      }
+
+      if (!recursive || !S_ISDIR(statbuf.st_mode)) {
+        fc_entry_add(dir, node, ent->d_name, &statbuf);
+        continue;
+      }
+    }
+
+    /* A sub-directory of a recursive Directory block. */
+    if (node != NULL) {
+      fc_node_add(dir, node, ent->d_name);
+    } else {
+      char abs_path[PATH_MAX];
+      int len = snprintf(abs_path, sizeof(abs_path), "%s/%s", path,
+                         ent->d_name);
+      if ((len < 0) || ((size_t)len >= sizeof(abs_path)))
+        continue;
+      fc_scan(dir, NULL, abs_path);
+    }
+  }
+
+  closedir(dh);
+  return 0;
+} /* }}} int fc_scan */
+
+static int fc_wd_compare(const void *a, const void *b) {
+  int wd_a = *((const int *)a);
+  int wd_b = *((const int *)b);
+  return (wd_a > wd_b) - (wd_a < wd_b);
+} /* int fc_wd_compare */
+
+/* Frees "node" and everything below it and, unless "keep_counts" is set,
+ * subtracts the files it counted. */
+static void fc_node_destroy(fc_directory_conf_t *dir, fc_node_t *node,
+                            bool keep_counts) /* {{{ */
+{
+  void *key;
+  void *value;
+
+  if (node == NULL)
+    return;
+
+  if (node->subdirs != NULL) {
+    while (c_avl_pick(node->subdirs, &key, &value) == 0)
+      fc_node_destroy(dir, value, keep_counts);
+    c_avl_destroy(node->subdirs);
+  }
+
+  if (node->files != NULL) {
+    while (c_avl_pick(node->files, &key, &value) == 0) {
+      fc_file_t *f = value;
+      if (!keep_counts) {
+        dir->files_num--;
+        dir->files_size -= f->size;
+      }
+      sfree(f);
+    }
+    c_avl_destroy(node->files);
+  }
+
+#if HAVE_SYS_INOTIFY_H
+  if (node->wd >= 0) {
+    c_avl_remove(dir->nodes_by_wd, &node->wd, NULL, NULL);
+    /* Fails harmlessly if the kernel already dropped the watch. */
+    if (dir->inotify_fd >= 0)
+      inotify_rm_watch(dir->inotify_fd, node->wd);
+  }
+#endif
+
+  sfree(node->path);
+  sfree(node);
+} /* }}} void fc_node_destroy */
+
+static void fc_tree_destroy(fc_directory_conf_t *dir) {
+  if (dir->inotify_fd >= 0) {
+    close(dir->inotify_fd);
+    dir->inotify_fd = -1;
+  }
+
+  fc_node_destroy(dir, dir->root, /* keep_counts = */ true);
+  dir->root = NULL;
+
+  if (dir->nodes_by_wd != NULL) {
+    c_avl_destroy(dir->nodes_by_wd);
+    dir->nodes_by_wd = NULL;
+  }
+} /* void fc_tree_destroy */
+
+#if HAVE_SYS_INOTIFY_H
+/* Adds the directory "name" below "parent", or the root if "parent" is NULL,
+ * and scans it. */
+static fc_node_t *fc_node_add(fc_directory_conf_t *dir, fc_node_t *parent,
+                              char const *name) /* {{{ */
+{
+  fc_node_t *node;
+
+  if ((parent != NULL) && (c_avl_get(parent->subdirs, name, NULL) == 0))
+    return NULL;
+
+  node = calloc(1, sizeof(*node));
+  if (node == NULL)
+    return NULL;
+  node->wd = -1;
+
+  if (parent == NULL) {
+    node->path = strdup(dir->path);
+  } else {
+    size_t len = strlen(parent->path) + strlen(name) + 2;
+    node->path = malloc(len);
+    if (node->path != NULL)
+      snprintf(node->path, len, "%s/%s", parent->path, name);
+  }
+  node->files = c_avl_create((int (*)(const void *, const void *))strcmp);
+  node->subdirs = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if ((node->path == NULL) || (node->files == NULL) ||
+      (node->subdirs == NULL)) {
+    fc_node_destroy(dir, node, /* keep_counts = */ true);
+    return NULL;
+  }
+  node->name = node->path;
+  if (parent != NULL)
+    node->name += strlen(parent->path) + 1;
+
+  /* Watch before reading the directory, so no file created in between is
+   * missed. */
+  if (!dir->rescan) {
+    node->wd = inotify_add_watch(dir->inotify_fd, node->path, FC_INOTIFY_MASK);
+    if (node->wd < 0) {
+      c_complain(LOG_WARNING, &dir->watch_complaint,
+                 "filecount plugin: inotify_add_watch (\"%s\") failed: %s. "
+                 "'%s' will be scanned on every read.",
+                 node->path, STRERRNO, dir->path);
+      dir->rescan = true;
+    } else if (c_avl_insert(dir->nodes_by_wd, &node->wd, node) != 0) {
+      /* The kernel returns the same descriptor for a directory that is
+       * watched already, e.g. a bind mount within the tree. */
+      c_complain(LOG_WARNING, &dir->watch_complaint,
+                 "filecount plugin: \"%s\" is reachable twice below '%s', "
+                 "which will be scanned on every read.",
+                 node->path, dir->path);
+      node->wd = -1;
+      dir->rescan = true;
+    }
+  }
+
+  if ((parent != NULL) &&
+      (c_avl_insert(parent->subdirs, node->name, node) != 0)) {
+    fc_node_destroy(dir, node, /* keep_counts = */ true);
+    return NULL;
+  }
+
+  if (fc_scan(dir, node, node->path) != 0) {
+    if (parent != NULL) {
+      /* Gone again, or not readable. */
+      c_avl_remove(parent->subdirs, node->name, NULL, NULL);
+      fc_node_destroy(dir, node, /* keep_counts = */ false);
+    } else {
+      fc_node_destroy(dir, node, /* keep_counts = */ true);
+    }
+    return NULL;
+  }
+
+  return node;
+} /* }}} fc_node_t *fc_node_add */
+
+static int fc_tree_build(fc_directory_conf_t *dir) /* {{{ */
+{
+  fc_tree_destroy(dir);
+
+  dir->files_num = 0;
+  dir->files_size = 0;
+  dir->last_scan = cdtime();
+
+  dir->nodes_by_wd = c_avl_create(fc_wd_compare);
+  if (dir->nodes_by_wd == NULL)
+    return ENOMEM;
+
+  dir->rescan = false;
+  dir->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (dir->inotify_fd < 0) {
+    c_complain(LOG_WARNING, &dir->watch_complaint,
+               "filecount plugin: inotify_init1 failed: %s. '%s' will be "
+               "scanned on every read.",
+               STRERRNO, dir->path);
+    dir->rescan = true;
+  }
+
+  dir->root = fc_node_add(dir, NULL, NULL);
+  if (dir->root == NULL) {
+    fc_tree_destroy(dir);
+    return -1;
+  }
+
+  if (!dir->rescan)
+    c_release(LOG_INFO, &dir->watch_complaint,
+              "filecount plugin: Watching '%s' with inotify again.",
+              dir->path);
+  return 0;
+} /* }}} int fc_tree_build */
+
+static void fc_entry_remove(fc_directory_conf_t *dir, fc_node_t *node,
+                            char const *name) {
+  fc_file_t *f = NULL;
+
+  if (c_avl_remove(node->files, name, NULL, (void *)&f) != 0)
+    return;
+
+  dir->files_num--;
+  dir->files_size -= f->size;
+  sfree(f);
+} /* void fc_entry_remove */
+
+static void fc_entry_update(fc_directory_conf_t *dir, fc_node_t *node,
+                            char const *name) {
+  char abs_path[PATH_MAX];
+  struct stat statbuf;
+
+  fc_entry_remove(dir, node, name);
+
+  int len = snprintf(abs_path, sizeof(abs_path), "%s/%s", node->path, name);
+  if ((len < 0) || ((size_t)len >= sizeof(abs_path)))
+    return;
+  if (lstat(abs_path, &statbuf) != 0)
+    return;
+
+  if ((dir->options & FC_RECURSIVE) && S_ISDIR(statbuf.st_mode))
+    return;
+
+  fc_entry_add(dir, node, name, &statbuf);
+} /* void fc_entry_update */
+
+/* Applies the changes reported by inotify since the last read. */
+static int fc_tree_update(fc_directory_conf_t *dir) /* {{{ */
+{
+  char buf[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+  bool recursive = (dir->options & FC_RECURSIVE) != 0;
+
+  if ((dir->root == NULL) || dir->rescan)
+    return fc_tree_build(dir);
+
+  if ((dir->rescan_interval > 0) &&
+      ((cdtime() - dir->last_scan) >= dir->rescan_interval))
+    return fc_tree_build(dir);
+
+  while (42) {
+    ssize_t len = read(dir->inotify_fd, buf, sizeof(buf));
+    if (len < 0) {
+      if (errno == EINTR)
+        continue;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        break;
+      ERROR("filecount plugin: Reading inotify events failed: %s", STRERRNO);
+      return fc_tree_build(dir);
+    }
+
+    for (char *ptr = buf; ptr < buf + len;) {
+      struct inotify_event const *ev = (struct inotify_event const *)ptr;
+      ptr += sizeof(*ev) + ev->len;
+
+      if (ev->mask & IN_Q_OVERFLOW) {
+        NOTICE("filecount plugin: inotify queue overflow, scanning '%s' "
+               "again.",
+               dir->path);
+        return fc_tree_build(dir);
+      }
+
+      fc_node_t *node = NULL;
+      if (c_avl_get(dir->nodes_by_wd, &ev->wd, (void *)&node) != 0)
+        continue;
+
+      /* Sub-directories are handled through the events of their parent. */
+      if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+        if (node == dir->root)
+          return fc_tree_build(dir);
+        continue;
+      }
+
+      if ((ev->len == 0) || fc_skip_name(dir, ev->name))
+        continue;
+
+      if ((ev->mask & IN_ISDIR) && recursive) {
+        fc_node_t *child = NULL;
+        if (c_avl_remove(node->subdirs, ev->name, NULL, (void *)&child) == 0)
+          fc_node_destroy(dir, child, /* keep_counts = */ false);
+        if (ev->mask & (IN_CREATE | IN_MOVED_TO))
+          fc_node_add(dir, node, ev->name);
+      } else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        fc_entry_remove(dir, node, ev->name);
+      } else {
+        fc_entry_update(dir, node, ev->name);
+      }
+    }
+  }
 
   return 0;
-} /* int fc_read_dir_callback */
+} /* }}} int fc_tree_update */
+#else  /* !HAVE_SYS_INOTIFY_H */
+static fc_node_t *fc_node_add(__attribute__((unused)) fc_directory_conf_t *dir,
+                              __attribute__((unused)) fc_node_t *parent,
+                              __attribute__((unused)) char const *name) {
+  return NULL;
+}
+
+static int fc_tree_update(__attribute__((unused)) fc_directory_conf_t *dir) {
+  return ENOTSUP;
+}
+#endif /* HAVE_SYS_INOTIFY_H */
 
 static int fc_read_dir(fc_directory_conf_t *dir) {
+  if (dir->incremental) {
+    if (fc_tree_update(dir) != 0) {
+      WARNING("filecount plugin: Scanning '%s' failed.", dir->path);
+      return -1;
+    }
+
+    fc_submit_dir(dir);
+    return 0;
+  }
+
   dir->files_num = 0;
   dir->files_size = 0;
 
   if (dir->mtime != 0)
     dir->now = time(NULL);
 
-  int status =
-      walk_directory(dir->path, fc_read_dir_callback, dir,
-                     /* include hidden */ (dir->options & FC_HIDDEN) ? 1 : 0);
+  int status = fc_scan(dir, /* node = */ NULL, dir->path);
   if (status != 0) {
-    WARNING("filecount plugin: walk_directory (%s) failed.", dir->path);
+    WARNING("filecount plugin: Scanning '%s' failed.", dir->path);
     return -1;
   }
 
@@ -548,8 +988,18 @@ static int fc_read(void) {
   return 0;
 } /* int fc_read */
 
+static int fc_shutdown(void) {
+  for (size_t i = 0; i < directories_num; i++)
+    fc_free_dir(directories[i]);
+  sfree(directories);
+  directories_num = 0;
+
+  return 0;
+} /* int fc_shutdown */
+
 void module_register(void) {
   plugin_register_complex_config("filecount", fc_config);
   plugin_register_init("filecount", fc_init);
   plugin_register_read("filecount", fc_read);
+  plugin_register_shutdown("filecount", fc_shutdown);
 } /* void module_register */
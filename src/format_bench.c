@@ -0,0 +1,523 @@
+/**
+ * collectd - src/format_bench.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+/* Formatter and parser benchmark. Generates value lists with short and long
+ * identifiers, one and four data sources, with and without meta data, and
+ * measures the time and output size per value of the JSON and Graphite
+ * formatters, the network plugin's encoder and parser, and the PUTVAL
+ * parsers. Build it with "make bench_format".
+ *
+ * The network plugin is included so that its static functions can be
+ * called, as in network_test.c. Dispatching goes to plugin_mock.c and does
+ * nothing, so the parsers are measured on their own. */
+
+#include "network.c" /* (sic) */
+
+#include "utils/cmds/cmds.h"
+#include "utils/cmds/putval.h"
+#include "utils/format_graphite/format_graphite.h"
+#include "utils/format_json/format_json.h"
+#include "utils/strbuf/strbuf.h"
+
+#include <getopt.h>
+
+#define DEF_VALUES 1000000
+#define DEF_SERIES 1000
+
+static long conf_values = DEF_VALUES;
+static long conf_series = DEF_SERIES;
+static char const *conf_benchmark;
+static bool conf_json;
+
+/*
+ * Test data
+ */
+typedef struct {
+  size_t ds_num;
+  bool long_names;
+  bool meta;
+} bench_case_t;
+
+static bench_case_t const bench_cases[] = {
+    {1, false, false}, {1, false, true}, {1, true, false}, {1, true, true},
+    {4, false, false}, {4, false, true}, {4, true, false}, {4, true, true},
+};
+
+/* Gauges and derives take turns, so both number formats are exercised. */
+static data_source_t bench_sources[] = {
+    {"value", DS_TYPE_GAUGE, NAN, NAN},
+    {"rx", DS_TYPE_DERIVE, 0.0, NAN},
+    {"tx", DS_TYPE_GAUGE, NAN, NAN},
+    {"errors", DS_TYPE_DERIVE, 0.0, NAN},
+};
+static data_set_t bench_ds1 = {"bench1", 1, bench_sources};
+static data_set_t bench_ds4 = {"bench4", 4, bench_sources};
+
+typedef struct {
+  data_set_t const *ds;
+  value_list_t *vls;
+  value_t *values;
+  char **putval; /* PUTVAL lines */
+} bench_data_t;
+
+static uint64_t nanotime(void) {
+  struct timespec ts = {0};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/* Builds a PUTVAL line for `vl'. Meta data becomes "meta:" options, which
+ * only support strings. */
+static char *bench_putval_line(data_set_t const *ds, value_list_t const *vl,
+                               bool meta) {
+  char ident[6 * DATA_MAX_NAME_LEN];
+  char values[512];
+
+  if ((FORMAT_VL(ident, sizeof(ident), vl) != 0) ||
+      (format_values(values, sizeof(values), ds, vl,
+                     /* store rates = */ false) != 0))
+    return NULL;
+
+  char line[1024];
+  ssnprintf(line, sizeof(line), "PUTVAL %s interval=%.3f%s %s", ident,
+            CDTIME_T_TO_DOUBLE(vl->interval),
+            meta ? " meta:source=\"snmp-poller-3\" meta:ifindex=\"17\"" : "",
+            values);
+  return strdup(line);
+}
+
+static int bench_data_create(bench_data_t *d, bench_case_t const *c) {
+  d->ds = (c->ds_num == 1) ? &bench_ds1 : &bench_ds4;
+  d->vls = calloc(conf_series, sizeof(*d->vls));
+  d->values = calloc(conf_series * c->ds_num, sizeof(*d->values));
+  d->putval = calloc(conf_series, sizeof(*d->putval));
+  if ((d->vls == NULL) || (d->values == NULL) || (d->putval == NULL))
+    return ENOMEM;
+
+  cdtime_t base = TIME_T_TO_CDTIME_T(1700000000);
+  for (long i = 0; i < conf_series; i++) {
+    value_list_t *vl = d->vls + i;
+
+    *vl = (value_list_t){
+        .values = d->values + i * c->ds_num,
+        .values_len = c->ds_num,
+        .time = base + (cdtime_t)i * 1048576,
+        .interval = TIME_T_TO_CDTIME_T(10),
+    };
+    /* A hundred series per host, as if a few hosts reported everything. */
+    if (c->long_names) {
+      ssnprintf(vl->host, sizeof(vl->host),
+                "node-%04ld.rack-17.eu-west-1.example.com", i / 100);
+      sstrncpy(vl->plugin, "interface", sizeof(vl->plugin));
+      ssnprintf(vl->plugin_instance, sizeof(vl->plugin_instance),
+                "bond0.%ld-storage-backend", i % 10);
+      ssnprintf(vl->type_instance, sizeof(vl->type_instance),
+                "queue-%ld-rx-packets-dropped", i);
+    } else {
+      ssnprintf(vl->host, sizeof(vl->host), "h%ld", i / 100);
+      sstrncpy(vl->plugin, "cpu", sizeof(vl->plugin));
+      ssnprintf(vl->plugin_instance, sizeof(vl->plugin_instance), "%ld",
+                i % 10);
+      ssnprintf(vl->type_instance, sizeof(vl->type_instance), "t%ld", i);
+    }
+    sstrncpy(vl->type, d->ds->type, sizeof(vl->type));
+
+    for (size_t j = 0; j < c->ds_num; j++) {
+      if (d->ds->ds[j].type == DS_TYPE_GAUGE)
+        vl->values[j].gauge = 1.37 * (double)i + 0.001 * (double)j;
+      else
+        vl->values[j].derive = 1000003 * (derive_t)i + (derive_t)j;
+    }
+
+    if (c->meta) {
+      vl->meta = meta_data_create();
+      if ((vl->meta == NULL) ||
+          (meta_data_add_string(vl->meta, "source", "snmp-poller-3") != 0) ||
+          (meta_data_add_signed_int(vl->meta, "ifindex", i) != 0) ||
+          (meta_data_add_double(vl->meta, "scale", 0.125) != 0))
+        return ENOMEM;
+    }
+
+    d->putval[i] = bench_putval_line(d->ds, vl, c->meta);
+    if (d->putval[i] == NULL)
+      return ENOMEM;
+  }
+
+  return 0;
+}
+
+static void bench_data_destroy(bench_data_t *d) {
+  for (long i = 0; (d->vls != NULL) && (i < conf_series); i++)
+    meta_data_destroy(d->vls[i].meta);
+  for (long i = 0; (d->putval != NULL) && (i < conf_series); i++)
+    sfree(d->putval[i]);
+  sfree(d->vls);
+  sfree(d->values);
+  sfree(d->putval);
+}
+
+/*
+ * Benchmarks
+ *
+ * Each benchmark handles `num' values, cycling through the series, and
+ * returns the number of bytes produced or consumed, or -1 on error.
+ */
+typedef int64_t (*bench_func_t)(bench_data_t const *d, long num);
+
+static int64_t bench_format_json(bench_data_t const *d, long num) {
+  strbuf_t buf = STRBUF_CREATE;
+  int64_t bytes = 0;
+
+  for (long i = 0; i < num; i++) {
+    /* Flush every 64 KiB, like write_http does with its default buffer. */
+    if (buf.pos > 65536) {
+      bytes += buf.pos;
+      strbuf_reset(&buf);
+    }
+    if (format_json_value_list_strbuf(&buf, d->ds, d->vls + (i % conf_series),
+                                      /* store rates = */ 0) != 0) {
+      STRBUF_DESTROY(buf);
+      return -1;
+    }
+  }
+  bytes += buf.pos;
+
+  STRBUF_DESTROY(buf);
+  return bytes;
+}
+
+static int64_t bench_format_graphite(bench_data_t const *d, long num) {
+  char buffer[4096];
+  int64_t bytes = 0;
+
+  for (long i = 0; i < num; i++) {
+    if (format_graphite(buffer, sizeof(buffer), d->ds,
+                        d->vls + (i % conf_series), "collectd.", NULL, '_',
+                        GRAPHITE_ALWAYS_APPEND_DS) != 0)
+      return -1;
+    bytes += strlen(buffer);
+  }
+
+  return bytes;
+}
+
+static int64_t bench_network_encode(bench_data_t const *d, long num) {
+  char packet[network_config_packet_size];
+  size_t fill = 0;
+  value_list_t vl_def = {0};
+  int64_t bytes = 0;
+
+  for (long i = 0; i < num; i++) {
+    value_list_t const *vl = d->vls + (i % conf_series);
+    int status = add_to_buffer(packet + fill, sizeof(packet) - fill, &vl_def,
+                               d->ds, vl);
+    if (status < 0) {
+      /* The packet is full: start the next one. */
+      bytes += fill;
+      fill = 0;
+      vl_def = (value_list_t){0};
+      status = add_to_buffer(packet, sizeof(packet), &vl_def, d->ds, vl);
+      if (status < 0)
+        return -1;
+    }
+    fill += (size_t)status;
+  }
+  bytes += fill;
+
+  return bytes;
+}
+
+typedef struct {
+  char *data;
+  size_t size;
+  long values;
+} bench_packet_t;
+
+static int64_t bench_network_parse(bench_data_t const *d, long num) {
+  bench_packet_t *packets = calloc(conf_series, sizeof(*packets));
+  size_t packets_num = 0;
+  if (packets == NULL)
+    return -1;
+
+  /* Encode every series once; not part of the measurement, but cheap
+   * compared to the parsing below. */
+  value_list_t vl_def = {0};
+  for (long i = 0; i < conf_series; i++) {
+    bench_packet_t *p = packets + packets_num;
+    if (p->data == NULL) {
+      p->data = malloc(network_config_packet_size);
+      if (p->data == NULL)
+        break;
+    }
+
+    int status = add_to_buffer(p->data + p->size,
+                               network_config_packet_size - p->size, &vl_def,
+                               d->ds, d->vls + i);
+    if (status < 0) {
+      packets_num++;
+      p = packets + packets_num;
+      vl_def = (value_list_t){0};
+      p->data = malloc(network_config_packet_size);
+      if (p->data == NULL)
+        break;
+      status = add_to_buffer(p->data, network_config_packet_size, &vl_def,
+                             d->ds, d->vls + i);
+      if (status < 0)
+        break;
+    }
+    p->size += (size_t)status;
+    p->values++;
+  }
+  if ((packets_num < (size_t)conf_series) && (packets[packets_num].size > 0))
+    packets_num++;
+  if (packets_num == 0) {
+    sfree(packets);
+    return -1;
+  }
+
+  sockent_t se = {0};
+  derive_t dispatched = stats_values_dispatched;
+  long parsed = 0;
+  int64_t bytes = 0;
+  for (size_t i = 0; parsed < num; i = (i + 1) % packets_num) {
+    if (parse_packet(&se, packets[i].data, packets[i].size, /* flags = */ 0,
+                     /* username = */ NULL, /* address = */ NULL) != 0) {
+      bytes = -1;
+      break;
+    }
+    parsed += packets[i].values;
+    bytes += packets[i].size;
+  }
+  if ((bytes >= 0) && ((stats_values_dispatched - dispatched) != parsed))
+    bytes = -1;
+
+  for (long i = 0; i < conf_series; i++)
+    sfree(packets[i].data);
+  sfree(packets);
+
+  /* Whole packets are parsed, so there may be a few more than `num' values;
+   * scale the result accordingly. */
+  return (bytes < 0) ? -1 : (int64_t)((double)bytes * num / parsed);
+}
+
+/* Errors are reported by the failing return value; cmd_parse() also
+ * "reports" options it ignores, such as the "meta:" options, which would
+ * flood the terminal. */
+static void bench_cmd_error(void __attribute__((unused)) * ud,
+                            cmd_status_t __attribute__((unused)) status,
+                            const char __attribute__((unused)) * format,
+                            va_list __attribute__((unused)) ap) {}
+
+/* The path cmd_handle_putval() takes: the fast parser, and cmd_parse() on a
+ * copy of the line for anything it doesn't handle (here: "meta:"). */
+static int64_t bench_putval(bench_data_t const *d, long num) {
+  cmd_options_t opts = {0};
+  cmd_error_handler_t err = {bench_cmd_error, NULL};
+  char copy[1024];
+  int64_t bytes = 0;
+
+  for (long i = 0; i < num; i++) {
+    char const *line = d->putval[i % conf_series];
+    size_t len = strlen(line);
+    bytes += len;
+
+    cmd_putval_fast_t fast;
+    if (cmd_parse_putval_fast(line, &fast))
+      continue;
+
+    cmd_t cmd;
+    memcpy(copy, line, len + 1);
+    if (cmd_parse(copy, &cmd, &opts, &err) != CMD_OK)
+      return -1;
+    cmd_destroy(&cmd);
+  }
+
+  return bytes;
+}
+
+/* cmd_parse() only, as used for all other commands. */
+static int64_t bench_putval_parse(bench_data_t const *d, long num) {
+  cmd_options_t opts = {0};
+  cmd_error_handler_t err = {bench_cmd_error, NULL};
+  char copy[1024];
+  int64_t bytes = 0;
+
+  for (long i = 0; i < num; i++) {
+    char const *line = d->putval[i % conf_series];
+    size_t len = strlen(line);
+    bytes += len;
+
+    cmd_t cmd;
+    memcpy(copy, line, len + 1);
+    if (cmd_parse(copy, &cmd, &opts, &err) != CMD_OK)
+      return -1;
+    cmd_destroy(&cmd);
+  }
+
+  return bytes;
+}
+
+static struct {
+  char const *name;
+  bench_func_t func;
+} const benchmarks[] = {
+    {"format_json", bench_format_json},
+    {"format_graphite", bench_format_graphite},
+    {"network_encode", bench_network_encode},
+    {"network_parse", bench_network_parse},
+    {"putval", bench_putval},
+    {"putval_parse", bench_putval_parse},
+};
+
+static void bench_report(char const *name, bench_case_t const *c,
+                         double ns_per_value, double bytes_per_value) {
+  char const *names = c->long_names ? "long" : "short";
+
+  if (conf_json) {
+    printf("{\"benchmark\":\"%s\",\"ds_num\":%" PRIsz ",\"names\":\"%s\","
+           "\"meta\":%s,\"values\":%ld,\"ns_per_value\":%.1f,"
+           "\"bytes_per_value\":%.1f}\n",
+           name, c->ds_num, names, c->meta ? "true" : "false", conf_values,
+           ns_per_value, bytes_per_value);
+  } else {
+    printf("%-16s %2" PRIsz "  %-5s  %-4s %10.1f %12.1f\n", name, c->ds_num,
+           names, c->meta ? "yes" : "no", ns_per_value, bytes_per_value);
+  }
+  fflush(stdout);
+}
+
+/*
+ * Main
+ */
+__attribute__((noreturn)) static void exit_usage(int exit_status) {
+  fprintf((exit_status == EXIT_FAILURE) ? stderr : stdout,
+          "bench_format -- collectd formatter and parser benchmark\n"
+          "\n"
+          "  Usage: bench_format [OPTION]\n"
+          "\n"
+          "  Valid options:\n"
+          "    -n <number>    Values per benchmark and case. (Default: %d)\n"
+          "    -s <number>    Number of series. (Default: %d)\n"
+          "    -b <name>      Only run the benchmark <name>.\n"
+          "    -j             Print one JSON object per result.\n"
+          "    -h             Print usage information (this output).\n"
+          "\n"
+          "  Benchmarks: format_json, format_graphite, network_encode,\n"
+          "  network_parse, putval, putval_parse.\n",
+          DEF_VALUES, DEF_SERIES);
+  exit(exit_status);
+}
+
+static long get_long_opt(char const *str) {
+  char *endptr = NULL;
+
+  errno = 0;
+  long ret = strtol(str, &endptr, 0);
+  if ((errno != 0) || (endptr == str) || (*endptr != 0) || (ret < 1)) {
+    fprintf(stderr, "Not a valid number: \"%s\"\n", str);
+    exit(EXIT_FAILURE);
+  }
+
+  return ret;
+}
+
+static void read_options(int argc, char **argv) {
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:s:b:jh")) != -1) {
+    switch (opt) {
+    case 'n':
+      conf_values = get_long_opt(optarg);
+      break;
+    case 's':
+      conf_series = get_long_opt(optarg);
+      break;
+    case 'b':
+      conf_benchmark = optarg;
+      break;
+    case 'j':
+      conf_json = true;
+      break;
+    case 'h':
+      exit_usage(EXIT_SUCCESS);
+    default:
+      exit_usage(EXIT_FAILURE);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  read_options(argc, argv);
+
+  plugin_register_data_set(&bench_ds1);
+  plugin_register_data_set(&bench_ds4);
+
+  if (!conf_json)
+    printf("%-16s %2s  %-5s  %-4s %10s %12s\n", "benchmark", "ds", "names",
+           "meta", "ns/value", "bytes/value");
+
+  int ret = EXIT_SUCCESS;
+  bool found = false;
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(benchmarks); i++) {
+    if ((conf_benchmark != NULL) &&
+        (strcmp(conf_benchmark, benchmarks[i].name) != 0))
+      continue;
+    found = true;
+
+    for (size_t j = 0; j < STATIC_ARRAY_SIZE(bench_cases); j++) {
+      bench_case_t const *c = bench_cases + j;
+      bench_data_t d = {0};
+
+      if (bench_data_create(&d, c) != 0) {
+        fprintf(stderr, "Creating the test data failed.\n");
+        bench_data_destroy(&d);
+        return EXIT_FAILURE;
+      }
+
+      /* Warm up caches, e.g. the PUTVAL parser's identifier cache. */
+      int64_t bytes = benchmarks[i].func(&d, conf_series);
+
+      uint64_t begin = nanotime();
+      if (bytes >= 0)
+        bytes = benchmarks[i].func(&d, conf_values);
+      uint64_t elapsed = nanotime() - begin;
+
+      if (bytes < 0) {
+        fprintf(stderr, "%s failed.\n", benchmarks[i].name);
+        ret = EXIT_FAILURE;
+      } else {
+        bench_report(benchmarks[i].name, c,
+                     (double)elapsed / (double)conf_values,
+                     (double)bytes / (double)conf_values);
+      }
+      bench_data_destroy(&d);
+    }
+  }
+
+  if (!found) {
+    fprintf(stderr, "Unknown benchmark: \"%s\"\n", conf_benchmark);
+    exit_usage(EXIT_FAILURE);
+  }
+
+  return ret;
+}
@@ -30,9 +30,9 @@ SOFTWARE.
 
 #define PLUGIN_NAME "gpu_nvidia"
 
-static nvmlReturn_t nv_status = NVML_SUCCESS;
-static char *nv_errline = "";
-
+// TRY_CATCH() and TRY_CATCH_OPTIONAL() store the result and the failed call in
+// the local variables "nv_status" and "nv_errline", since GPUs are read from
+// several threads at once.
 #define TRY_CATCH(f, catch)                                                    \
   if ((nv_status = f) != NVML_SUCCESS) {                                       \
     nv_errline = #f;                                                           \
@@ -82,7 +82,7 @@ static int nvml_config(const char *key, const char *value) {
             ": At most 64 GPUs (0 <= GPUIndex < 64) are supported!");
       return -2;
     }
-    conf_match_mask |= (1 << device_ix);
+    conf_match_mask |= (UINT64_C(1) << device_ix);
   } else if (strcasecmp(key, KEY_IGNORESELECTED) == 0) {
     conf_mask_is_exclude = IS_TRUE(value);
   } else if (strcasecmp(key, KEY_INSTANCE_BY_GPUINDEX) == 0) {
@@ -103,19 +103,171 @@ static int nvml_config(const char *key, const char *value) {
   return 0;
 }
 
+// State of one monitored GPU. Every GPU is read by a thread of its own, so
+// that a GPU that is slow to answer does not hold up the others. Some NVML
+// calls block for milliseconds.
+typedef struct {
+  pthread_t thread;
+  bool thread_running;
+
+  unsigned int index;
+  nvmlDevice_t dev;
+  char name[NVML_DEVICE_NAME_BUFFER_SIZE];
+
+  // Buffer for nvmlDeviceGetSamples() and the time stamp of the newest
+  // utilization sample seen so far.
+  nvmlSample_t *samples;
+  unsigned int samples_num;
+  unsigned long long last_sample_ts;
+  bool no_samples;
+
+  bool no_field_values;
+} nvml_gpu_t;
+
+static nvml_gpu_t *gpus[64];
+static size_t gpus_num;
+
+static pthread_mutex_t gpu_thread_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gpu_thread_cond = PTHREAD_COND_INITIALIZER;
+static bool gpu_thread_loop;
+static cdtime_t gpu_interval;
+
+static void nvml_gpu_free(nvml_gpu_t *gpu) {
+  if (gpu == NULL)
+    return;
+
+  free(gpu->samples);
+  free(gpu);
+}
+
+static int nvml_read_gpu(nvml_gpu_t *gpu);
+
+static void *nvml_gpu_thread(void *arg) {
+  nvml_gpu_t *gpu = arg;
+  cdtime_t next = cdtime();
+
+  pthread_mutex_lock(&gpu_thread_lock);
+  while (gpu_thread_loop) {
+    pthread_mutex_unlock(&gpu_thread_lock);
+    nvml_read_gpu(gpu);
+    pthread_mutex_lock(&gpu_thread_lock);
+
+    // Skip reads that were missed because the GPU was too slow to answer.
+    cdtime_t now = cdtime();
+    next += gpu_interval;
+    if (next < now)
+      next = now + gpu_interval - ((now - next) % gpu_interval);
+
+    while (gpu_thread_loop && (cdtime() < next))
+      pthread_cond_timedwait(&gpu_thread_cond, &gpu_thread_lock,
+                             &CDTIME_T_TO_TIMESPEC(next));
+  }
+  pthread_mutex_unlock(&gpu_thread_lock);
+
+  return NULL;
+}
+
 static int nvml_init(void) {
+  nvmlReturn_t nv_status = NVML_SUCCESS;
+  char const *nv_errline = "";
+
   TRY(nvmlInit());
+
+  unsigned int device_count;
+  TRY(nvmlDeviceGetCount(&device_count));
+
+  if (device_count > 64) {
+    device_count = 64;
+  }
+
+  for (unsigned int ix = 0; ix < device_count; ix++) {
+    unsigned int is_match =
+        ((UINT64_C(1) << ix) & conf_match_mask) || (conf_match_mask == 0);
+    if (conf_mask_is_exclude == !!is_match) {
+      continue;
+    }
+
+    nvml_gpu_t *gpu = calloc(1, sizeof(*gpu));
+    if (gpu == NULL) {
+      ERROR(PLUGIN_NAME ": calloc failed.");
+      continue;
+    }
+    gpu->index = ix;
+
+    if ((nv_status = nvmlDeviceGetHandleByIndex(ix, &gpu->dev)) !=
+        NVML_SUCCESS) {
+      WARNING(PLUGIN_NAME ": nvmlDeviceGetHandleByIndex failed (%d) on dev "
+                          "at index %u!",
+              nv_status, ix);
+      nvml_gpu_free(gpu);
+      continue;
+    }
+
+    if ((instance_by & INSTANCE_BY_GPUNAME) &&
+        (nv_status = nvmlDeviceGetName(gpu->dev, gpu->name,
+                                       sizeof(gpu->name))) != NVML_SUCCESS) {
+      WARNING(PLUGIN_NAME ": nvmlDeviceGetName failed (%d) on dev at index "
+                          "%u!",
+              nv_status, ix);
+      nvml_gpu_free(gpu);
+      continue;
+    }
+
+    gpus[gpus_num++] = gpu;
+  }
+
+  if (gpus_num == 0) {
+    WARNING(PLUGIN_NAME ": No GPUs are monitored.");
+    return 0;
+  }
+
+  gpu_interval = plugin_get_interval();
+  gpu_thread_loop = true;
+  for (size_t i = 0; i < gpus_num; i++) {
+    char thread_name[16];
+    snprintf(thread_name, sizeof(thread_name), "gpu_nvidia#%u",
+             gpus[i]->index);
+
+    int status = plugin_thread_create(&gpus[i]->thread, nvml_gpu_thread,
+                                      gpus[i], thread_name);
+    if (status != 0) {
+      ERROR(PLUGIN_NAME ": Starting the thread for the GPU at index %u "
+                        "failed: %s",
+            gpus[i]->index, STRERROR(status));
+      continue;
+    }
+    gpus[i]->thread_running = true;
+  }
+
   return 0;
 
-  catch : ERROR(PLUGIN_NAME ": NVML init failed with %d", nv_status);
+  catch : ERROR(PLUGIN_NAME ": NVML init failed with %d (\"%s\")", nv_status,
+                nv_errline);
   return -1;
 }
 
 static int nvml_shutdown(void) {
+  nvmlReturn_t nv_status = NVML_SUCCESS;
+  char const *nv_errline = "";
+
+  pthread_mutex_lock(&gpu_thread_lock);
+  gpu_thread_loop = false;
+  pthread_cond_broadcast(&gpu_thread_cond);
+  pthread_mutex_unlock(&gpu_thread_lock);
+
+  for (size_t i = 0; i < gpus_num; i++) {
+    if (gpus[i]->thread_running)
+      pthread_join(gpus[i]->thread, NULL);
+    nvml_gpu_free(gpus[i]);
+    gpus[i] = NULL;
+  }
+  gpus_num = 0;
+
   TRY(nvmlShutdown())
   return 0;
 
-  catch : ERROR(PLUGIN_NAME ": NVML shutdown failed with %d", nv_status);
+  catch : ERROR(PLUGIN_NAME ": NVML shutdown failed with %d (\"%s\")",
+                nv_status, nv_errline);
   return -1;
 }
 
@@ -149,94 +301,156 @@ static void nvml_submit_gauge(int device_idx, const char *device_name,
   plugin_dispatch_values(&vl);
 }
 
-static int nvml_read(void) {
-
-  unsigned int device_count;
-  TRY_CATCH(nvmlDeviceGetCount(&device_count), catch_nocount);
-
-  if (device_count > 64) {
-    device_count = 64;
+static gauge_t nvml_value_to_gauge(nvmlValueType_t type, nvmlValue_t v) {
+  switch (type) {
+  case NVML_VALUE_TYPE_DOUBLE:
+    return (gauge_t)v.dVal;
+  case NVML_VALUE_TYPE_UNSIGNED_INT:
+    return (gauge_t)v.uiVal;
+  case NVML_VALUE_TYPE_UNSIGNED_LONG:
+    return (gauge_t)v.ulVal;
+  case NVML_VALUE_TYPE_UNSIGNED_LONG_LONG:
+    return (gauge_t)v.ullVal;
+  default:
+    return NAN;
   }
+}
 
-  for (unsigned int ix = 0; ix < device_count; ix++) {
+// Reads the GPU utilization as the average of the samples the driver
+// buffered since the last read, rather than as a single point in time. Falls
+// back to nvmlDeviceGetUtilizationRates() if the device keeps no samples.
+static nvmlReturn_t nvml_read_utilization(nvml_gpu_t *gpu, gauge_t *ret) {
+  nvmlValueType_t type;
+  unsigned int num;
+  nvmlReturn_t status;
+
+  if (!gpu->no_samples && gpu->samples == NULL) {
+    status = nvmlDeviceGetSamples(gpu->dev, NVML_GPU_UTILIZATION_SAMPLES, 0,
+                                  &type, &num, NULL);
+    if (status == NVML_SUCCESS && num > 0)
+      gpu->samples = calloc(num, sizeof(*gpu->samples));
+    if (gpu->samples == NULL)
+      gpu->no_samples = true;
+    else
+      gpu->samples_num = num;
+  }
 
-    unsigned int is_match =
-        ((1 << ix) & conf_match_mask) || (conf_match_mask == 0);
-    if (conf_mask_is_exclude == !!is_match) {
-      continue;
+  if (!gpu->no_samples) {
+    num = gpu->samples_num;
+    status = nvmlDeviceGetSamples(gpu->dev, NVML_GPU_UTILIZATION_SAMPLES,
+                                  gpu->last_sample_ts, &type, &num,
+                                  gpu->samples);
+    if (status == NVML_SUCCESS && num > 0) {
+      gauge_t sum = 0;
+      for (unsigned int i = 0; i < num; i++) {
+        sum += nvml_value_to_gauge(type, gpu->samples[i].sampleValue);
+        if (gpu->samples[i].timeStamp > gpu->last_sample_ts)
+          gpu->last_sample_ts = gpu->samples[i].timeStamp;
+      }
+      *ret = sum / num;
+      return NVML_SUCCESS;
     }
+    // NOT_FOUND means that no sample was taken since the last read.
+    if (status != NVML_SUCCESS && status != NVML_ERROR_NOT_FOUND)
+      gpu->no_samples = true;
+  }
 
-    nvmlDevice_t dev;
-    TRY(nvmlDeviceGetHandleByIndex(ix, &dev));
+  nvmlUtilization_t utilization;
+  status = nvmlDeviceGetUtilizationRates(gpu->dev, &utilization);
+  if (status == NVML_SUCCESS)
+    *ret = utilization.gpu;
+  return status;
+}
 
-    char dev_name[NVML_DEVICE_NAME_BUFFER_SIZE] = {0};
-    if (instance_by & INSTANCE_BY_GPUNAME) {
-      TRY(nvmlDeviceGetName(dev, dev_name, NVML_DEVICE_NAME_BUFFER_SIZE));
-    }
+static int nvml_read_gpu(nvml_gpu_t *gpu) {
+  unsigned int ix = gpu->index;
+  nvmlDevice_t dev = gpu->dev;
+  char const *dev_name = gpu->name;
+  nvmlReturn_t nv_status = NVML_SUCCESS;
+  char const *nv_errline = "";
+
+  // Try to be as lenient as possible with the variety of devices that are
+  // out there, ignoring any NOT_SUPPORTED errors gently.
+  nvmlMemory_t meminfo;
+  TRYOPT(nvmlDeviceGetMemoryInfo(dev, &meminfo))
+  if (nv_status == NVML_SUCCESS) {
+    nvml_submit_gauge(ix, dev_name, "memory", "used", meminfo.used);
+    nvml_submit_gauge(ix, dev_name, "memory", "free", meminfo.free);
+  }
 
-    // Try to be as lenient as possible with the variety of devices that are
-    // out there, ignoring any NOT_SUPPORTED errors gently.
-    nvmlMemory_t meminfo;
-    TRYOPT(nvmlDeviceGetMemoryInfo(dev, &meminfo))
+  gauge_t gpu_used;
+  TRYOPT(nvml_read_utilization(gpu, &gpu_used))
+  if (nv_status == NVML_SUCCESS)
+    nvml_submit_gauge(ix, dev_name, "percent", "gpu_used", gpu_used);
+
+  unsigned int fan_speed;
+  TRYOPT(nvmlDeviceGetFanSpeed(dev, &fan_speed))
+  if (nv_status == NVML_SUCCESS)
+    nvml_submit_gauge(ix, dev_name, "fanspeed", NULL, fan_speed);
+
+  unsigned int core_temp;
+  TRYOPT(nvmlDeviceGetTemperature(dev, NVML_TEMPERATURE_GPU, &core_temp))
+  if (nv_status == NVML_SUCCESS)
+    nvml_submit_gauge(ix, dev_name, "temperature", "core", core_temp);
+
+  unsigned int sm_clk_mhz;
+  TRYOPT(nvmlDeviceGetClockInfo(dev, NVML_CLOCK_SM, &sm_clk_mhz))
+  if (nv_status == NVML_SUCCESS)
+    nvml_submit_gauge(ix, dev_name, "frequency", "multiprocessor",
+                      1e6 * sm_clk_mhz);
+
+  unsigned int mem_clk_mhz;
+  TRYOPT(nvmlDeviceGetClockInfo(dev, NVML_CLOCK_MEM, &mem_clk_mhz))
+  if (nv_status == NVML_SUCCESS)
+    nvml_submit_gauge(ix, dev_name, "frequency", "memory", 1e6 * mem_clk_mhz);
+
+  // Power and memory temperature are fetched with a single field value
+  // query where the driver supports it.
+  bool have_power = false;
+#if defined(NVML_FI_DEV_POWER_AVERAGE) && defined(NVML_FI_DEV_MEMORY_TEMP)
+  if (!gpu->no_field_values) {
+    nvmlFieldValue_t fields[] = {
+        {.fieldId = NVML_FI_DEV_POWER_AVERAGE},
+        {.fieldId = NVML_FI_DEV_MEMORY_TEMP},
+    };
+    nv_status = nvmlDeviceGetFieldValues(dev, STATIC_ARRAY_SIZE(fields),
+                                         fields);
     if (nv_status == NVML_SUCCESS) {
-      nvml_submit_gauge(ix, dev_name, "memory", "used", meminfo.used);
-      nvml_submit_gauge(ix, dev_name, "memory", "free", meminfo.free);
+      if (fields[0].nvmlReturn == NVML_SUCCESS) {
+        nvml_submit_gauge(
+            ix, dev_name, "power", NULL,
+            1e-3 * nvml_value_to_gauge(fields[0].valueType, fields[0].value));
+        have_power = true;
+      }
+      if (fields[1].nvmlReturn == NVML_SUCCESS)
+        nvml_submit_gauge(
+            ix, dev_name, "temperature", "memory",
+            nvml_value_to_gauge(fields[1].valueType, fields[1].value));
+    } else {
+      gpu->no_field_values = true;
     }
+  }
+#endif
 
-    nvmlUtilization_t utilization;
-    TRYOPT(nvmlDeviceGetUtilizationRates(dev, &utilization))
-    if (nv_status == NVML_SUCCESS)
-      nvml_submit_gauge(ix, dev_name, "percent", "gpu_used", utilization.gpu);
-
-    unsigned int fan_speed;
-    TRYOPT(nvmlDeviceGetFanSpeed(dev, &fan_speed))
-    if (nv_status == NVML_SUCCESS)
-      nvml_submit_gauge(ix, dev_name, "fanspeed", NULL, fan_speed);
-
-    unsigned int core_temp;
-    TRYOPT(nvmlDeviceGetTemperature(dev, NVML_TEMPERATURE_GPU, &core_temp))
-    if (nv_status == NVML_SUCCESS)
-      nvml_submit_gauge(ix, dev_name, "temperature", "core", core_temp);
-
-    unsigned int sm_clk_mhz;
-    TRYOPT(nvmlDeviceGetClockInfo(dev, NVML_CLOCK_SM, &sm_clk_mhz))
-    if (nv_status == NVML_SUCCESS)
-      nvml_submit_gauge(ix, dev_name, "frequency", "multiprocessor",
-                        1e6 * sm_clk_mhz);
-
-    unsigned int mem_clk_mhz;
-    TRYOPT(nvmlDeviceGetClockInfo(dev, NVML_CLOCK_MEM, &mem_clk_mhz))
-    if (nv_status == NVML_SUCCESS)
-      nvml_submit_gauge(ix, dev_name, "frequency", "memory", 1e6 * mem_clk_mhz);
-
+  if (!have_power) {
     unsigned int power_mW;
     TRYOPT(nvmlDeviceGetPowerUsage(dev, &power_mW))
     if (nv_status == NVML_SUCCESS)
       nvml_submit_gauge(ix, dev_name, "power", NULL, 1e-3 * power_mW);
-
-    continue;
-
-    // Failures here indicate transient errors or removal of GPU. In either
-    // case it will either be resolved or the GPU will no longer be enumerated
-    // the next time round.
-    catch : WARNING(PLUGIN_NAME
-                    ": NVML call \"%s\" failed (%d) on dev at index %d!",
-                    nv_errline, nv_status, ix);
-    continue;
   }
 
   return 0;
 
-// Failures here indicate serious misconfiguration; we bail out totally.
-catch_nocount:
-  ERROR(PLUGIN_NAME ": Failed to enumerate NVIDIA GPUs (\"%s\" returned %d)",
-        nv_errline, nv_status);
-  return -1;
+  // Failures here indicate transient errors or removal of GPU. In either
+  // case it will be resolved or keep being reported on the next read.
+  catch : WARNING(PLUGIN_NAME
+                  ": NVML call \"%s\" failed (%d) on dev at index %u!",
+                  nv_errline, nv_status, ix);
+  return 0;
 }
 
 void module_register(void) {
   plugin_register_init(PLUGIN_NAME, nvml_init);
   plugin_register_config(PLUGIN_NAME, nvml_config, config_keys, n_config_keys);
-  plugin_register_read(PLUGIN_NAME, nvml_read);
   plugin_register_shutdown(PLUGIN_NAME, nvml_shutdown);
 }
@@ -29,14 +29,15 @@
 #include <google/protobuf/util/time_util.h>
 #include <grpc++/grpc++.h>
 
+#include <chrono>
 #include <fstream>
 #include <iostream>
-#include <queue>
 #include <vector>
 
 #include "collectd.grpc.pb.h"
 
 extern "C" {
+#include <errno.h>
 #include <fnmatch.h>
 #include <stdbool.h>
 
@@ -71,6 +72,7 @@ struct Listener {
 };
 static std::vector<Listener> listeners;
 static grpc::string default_addr("0.0.0.0:50051");
+static size_t worker_threads_num = 2;
 
 /*
  * helper functions
@@ -393,140 +395,256 @@ static grpc::Status unmarshal_value_list(const collectd::types::ValueList &msg,
   return status;
 } /* unmarshal_value_list() */
 
+/* Dispatches all value lists of a PutValues request as one group. */
+static grpc::Status dispatch_put_values(PutValuesRequest const &req) {
+  std::vector<value_list_t> value_lists;
+  value_lists.reserve(req.value_lists_size() + 1);
+
+  grpc::Status status = grpc::Status::OK;
+  if (req.has_value_list()) {
+    value_list_t vl = {0};
+    status = unmarshal_value_list(req.value_list(), &vl);
+    if (status.ok())
+      value_lists.push_back(vl);
+  }
+
+  for (auto const &msg : req.value_lists()) {
+    if (!status.ok())
+      break;
+
+    value_list_t vl = {0};
+    status = unmarshal_value_list(msg, &vl);
+    if (status.ok())
+      value_lists.push_back(vl);
+  }
+
+  if (status.ok() && !value_lists.empty() &&
+      plugin_dispatch_value_lists(value_lists.data(), value_lists.size()))
+    status = grpc::Status(grpc::StatusCode::INTERNAL,
+                          grpc::string("failed to enqueue values for writing"));
+
+  for (auto &vl : value_lists) {
+    sfree(vl.values);
+    meta_data_destroy(vl.meta);
+  }
+
+  return status;
+} /* dispatch_put_values() */
+
 /*
  * Collectd service
+ *
+ * The service is implemented asynchronously: each worker thread owns a
+ * completion queue and every call is a small state machine driven by the
+ * events of that queue. The call object itself is used as the tag of its
+ * pending operation.
  */
-class CollectdImpl : public collectd::Collectd::Service {
+class Call {
 public:
-  grpc::Status
-  QueryValues(grpc::ServerContext *ctx, QueryValuesRequest const *req,
-              grpc::ServerWriter<QueryValuesResponse> *writer) override {
-    value_list_t match;
-    auto status = unmarshal_ident(req->identifier(), &match, false);
-    if (!status.ok()) {
-      return status;
-    }
+  virtual ~Call() {}
+  virtual void Proceed(bool ok) = 0;
+};
 
-    std::queue<value_list_t> value_lists;
-    status = this->queryValuesRead(&match, &value_lists);
-    if (status.ok()) {
-      status = this->queryValuesWrite(ctx, writer, &value_lists);
-    }
+class PutValuesCall final : public Call {
+public:
+  PutValuesCall(Collectd::AsyncService *service,
+                grpc::ServerCompletionQueue *cq)
+      : service_(service), cq_(cq), reader_(&ctx_), state_(CREATE) {
+    service_->RequestPutValues(&ctx_, &reader_, cq_, cq_, this);
+  }
 
-    while (!value_lists.empty()) {
-      auto vl = value_lists.front();
-      value_lists.pop();
-      sfree(vl.values);
-      meta_data_destroy(vl.meta);
-    }
+  void Proceed(bool ok) override {
+    switch (state_) {
+    case CREATE:
+      /* The server is shutting down. */
+      if (!ok) {
+        delete this;
+        return;
+      }
 
-    return status;
-  }
+      /* Accept the next call while handling this one. */
+      new PutValuesCall(service_, cq_);
 
-  grpc::Status PutValues(grpc::ServerContext *ctx,
-                         grpc::ServerReader<PutValuesRequest> *reader,
-                         PutValuesResponse *res) override {
-    PutValuesRequest req;
+      state_ = READ;
+      reader_.Read(&req_, this);
+      break;
 
-    while (reader->Read(&req)) {
-      value_list_t vl = {0};
-      auto status = unmarshal_value_list(req.value_list(), &vl);
-      if (!status.ok())
-        return status;
+    case READ: {
+      /* The client is done writing. */
+      if (!ok) {
+        state_ = FINISH;
+        res_.Clear();
+        reader_.Finish(res_, grpc::Status::OK, this);
+        break;
+      }
 
-      if (plugin_dispatch_values(&vl))
-        return grpc::Status(
-            grpc::StatusCode::INTERNAL,
-            grpc::string("failed to enqueue values for writing"));
+      auto status = dispatch_put_values(req_);
+      if (!status.ok()) {
+        state_ = FINISH;
+        reader_.FinishWithError(status, this);
+        break;
+      }
+
+      req_.Clear();
+      reader_.Read(&req_, this);
+      break;
     }
 
-    res->Clear();
-    return grpc::Status::OK;
+    case FINISH:
+      delete this;
+      break;
+    }
   }
 
 private:
-  grpc::Status queryValuesRead(value_list_t const *match,
-                               std::queue<value_list_t> *value_lists) {
-    uc_iter_t *iter;
-    if ((iter = uc_get_iterator()) == NULL) {
-      return grpc::Status(
-          grpc::StatusCode::INTERNAL,
-          grpc::string("failed to query values: cannot create iterator"));
-    }
+  Collectd::AsyncService *service_;
+  grpc::ServerCompletionQueue *cq_;
+  grpc::ServerContext ctx_;
+  grpc::ServerAsyncReader<PutValuesResponse, PutValuesRequest> reader_;
+
+  PutValuesRequest req_;
+  PutValuesResponse res_;
+
+  enum { CREATE, READ, FINISH } state_;
+}; /* class PutValuesCall */
+
+/* QueryValuesCall walks a snapshot of the value cache, so no cache lock is
+ * held while matching identifiers or while waiting for the client. Only the
+ * values of matching entries are copied, one at a time, right before they are
+ * written to the stream. */
+class QueryValuesCall final : public Call {
+public:
+  QueryValuesCall(Collectd::AsyncService *service,
+                  grpc::ServerCompletionQueue *cq)
+      : service_(service), cq_(cq), writer_(&ctx_), snap_(nullptr), index_(0),
+        state_(CREATE) {
+    service_->RequestQueryValues(&ctx_, &req_, &writer_, cq_, cq_, this);
+  }
 
-    grpc::Status status = grpc::Status::OK;
-    char *name = NULL;
-    while (uc_iterator_next(iter, &name) == 0) {
-      value_list_t vl;
-      if (parse_identifier_vl(name, &vl) != 0) {
-        status = grpc::Status(grpc::StatusCode::INTERNAL,
-                              grpc::string("failed to parse identifier"));
-        break;
-      }
+  ~QueryValuesCall() {
+    if (snap_ != nullptr)
+      uc_snapshot_release(snap_);
+  }
 
-      if (!ident_matches(&vl, match))
-        continue;
-      if (uc_iterator_get_time(iter, &vl.time) < 0) {
-        status =
-            grpc::Status(grpc::StatusCode::INTERNAL,
-                         grpc::string("failed to retrieve value timestamp"));
-        break;
+  void Proceed(bool ok) override {
+    switch (state_) {
+    case CREATE: {
+      if (!ok) {
+        delete this;
+        return;
       }
-      if (uc_iterator_get_interval(iter, &vl.interval) < 0) {
-        status =
-            grpc::Status(grpc::StatusCode::INTERNAL,
-                         grpc::string("failed to retrieve value interval"));
+
+      new QueryValuesCall(service_, cq_);
+
+      auto status = unmarshal_ident(req_.identifier(), &match_, false);
+      if (!status.ok()) {
+        Finish(status);
         break;
       }
-      if (uc_iterator_get_values(iter, &vl.values, &vl.values_len) < 0) {
-        status = grpc::Status(grpc::StatusCode::INTERNAL,
-                              grpc::string("failed to retrieve values"));
+
+      if ((snap_ = uc_snapshot_acquire()) == nullptr) {
+        Finish(grpc::Status(
+            grpc::StatusCode::INTERNAL,
+            grpc::string("failed to query values: cannot create snapshot")));
         break;
       }
-      if (uc_iterator_get_meta(iter, &vl.meta) < 0) {
-        status =
-            grpc::Status(grpc::StatusCode::INTERNAL,
-                         grpc::string("failed to retrieve value metadata"));
+
+      state_ = WRITE;
+      WriteNext();
+      break;
+    }
+
+    case WRITE:
+      /* The client went away. */
+      if (!ok) {
+        delete this;
+        return;
       }
+      WriteNext();
+      break;
 
-      value_lists->push(vl);
-    } // while (uc_iterator_next(iter, &name) == 0)
+    case FINISH:
+      delete this;
+      break;
+    }
+  }
 
-    uc_iterator_destroy(iter);
-    return status;
+private:
+  void Finish(grpc::Status const &status) {
+    state_ = FINISH;
+    writer_.Finish(status, this);
   }
 
-  grpc::Status queryValuesWrite(grpc::ServerContext *ctx,
-                                grpc::ServerWriter<QueryValuesResponse> *writer,
-                                std::queue<value_list_t> *value_lists) {
-    while (!value_lists->empty()) {
-      auto vl = value_lists->front();
-      QueryValuesResponse res;
-      res.Clear();
+  /* Writes the next matching value list or finishes the call. */
+  void WriteNext() {
+    size_t snap_size = uc_snapshot_size(snap_);
 
-      auto status = marshal_value_list(&vl, res.mutable_value_list());
-      if (!status.ok()) {
-        return status;
+    while (index_ < snap_size) {
+      size_t i = index_++;
+
+      uc_snapshot_entry_t entry;
+      if ((uc_snapshot_get(snap_, i, &entry) != 0) ||
+          (entry.state == STATE_MISSING))
+        continue;
+
+      value_list_t vl = {0};
+      if (parse_identifier_vl(entry.name, &vl) != 0) {
+        Finish(grpc::Status(grpc::StatusCode::INTERNAL,
+                            grpc::string("failed to parse identifier")));
+        return;
       }
+      if (!ident_matches(&vl, &match_))
+        continue;
 
-      if (!writer->Write(res)) {
-        return grpc::Status::CANCELLED;
+      vl.time = entry.time;
+      vl.interval = entry.interval;
+
+      int status =
+          uc_snapshot_get_values(snap_, i, &vl.values, &vl.values_len, &vl.meta);
+      if (status == ENOENT)
+        continue;
+      if (status != 0) {
+        Finish(grpc::Status(grpc::StatusCode::INTERNAL,
+                            grpc::string("failed to retrieve values")));
+        return;
       }
 
-      value_lists->pop();
+      QueryValuesResponse res;
+      auto s = marshal_value_list(&vl, res.mutable_value_list());
       sfree(vl.values);
+      meta_data_destroy(vl.meta);
+      if (!s.ok()) {
+        Finish(s);
+        return;
+      }
+
+      writer_.Write(res, this);
+      return;
     }
 
-    return grpc::Status::OK;
+    Finish(grpc::Status::OK);
   }
-};
+
+  Collectd::AsyncService *service_;
+  grpc::ServerCompletionQueue *cq_;
+  grpc::ServerContext ctx_;
+  grpc::ServerAsyncWriter<QueryValuesResponse> writer_;
+
+  QueryValuesRequest req_;
+  value_list_t match_;
+
+  uc_snapshot_t *snap_;
+  size_t index_;
+
+  enum { CREATE, WRITE, FINISH } state_;
+}; /* class QueryValuesCall */
 
 /*
  * gRPC server implementation
  */
 class CollectdServer final {
 public:
-  void Start() {
+  bool Start() {
     auto auth = grpc::InsecureServerCredentials();
 
     grpc::ServerBuilder builder;
@@ -552,15 +670,70 @@ public:
 
     builder.RegisterService(&collectd_service_);
 
+    for (size_t i = 0; i < worker_threads_num; i++)
+      cqs_.push_back(builder.AddCompletionQueue());
+
     server_ = builder.BuildAndStart();
+    if (server_ == nullptr) {
+      ERROR("grpc: Failed to start server");
+      return false;
+    }
+
+    /* Workers are started for a prefix of cqs_; calls are only requested on
+     * queues that have a worker. */
+    for (auto &cq : cqs_) {
+      pthread_t tid;
+      int status = plugin_thread_create(&tid, WorkerThread, cq.get(),
+                                        "grpc worker");
+      if (status != 0) {
+        ERROR("grpc: Failed to start worker thread (status %d)", status);
+        break;
+      }
+      threads_.push_back(tid);
+
+      new PutValuesCall(&collectd_service_, cq.get());
+      new QueryValuesCall(&collectd_service_, cq.get());
+    }
+
+    return !threads_.empty();
   } /* Start() */
 
-  void Shutdown() { server_->Shutdown(); } /* Shutdown() */
+  void Shutdown() {
+    /* Calls still running after a second, e.g. idle PutValues streams, are
+     * cancelled. They complete with ok == false and delete themselves; the
+     * workers return once their queue has been drained. */
+    if (server_ != nullptr)
+      server_->Shutdown(std::chrono::system_clock::now() +
+                        std::chrono::seconds(1));
+
+    for (auto &cq : cqs_)
+      cq->Shutdown();
+    for (auto tid : threads_)
+      pthread_join(tid, NULL);
+
+    /* Queues without a worker still have to be drained. */
+    for (size_t i = threads_.size(); i < cqs_.size(); i++)
+      WorkerThread(cqs_[i].get());
+    threads_.clear();
+  } /* Shutdown() */
 
 private:
-  CollectdImpl collectd_service_;
+  static void *WorkerThread(void *arg) {
+    grpc::ServerCompletionQueue *cq = (grpc::ServerCompletionQueue *)arg;
+    void *tag;
+    bool ok;
+
+    while (cq->Next(&tag, &ok))
+      static_cast<Call *>(tag)->Proceed(ok);
+
+    return NULL;
+  } /* WorkerThread() */
+
+  Collectd::AsyncService collectd_service_;
 
   std::unique_ptr<grpc::Server> server_;
+  std::vector<std::unique_ptr<grpc::ServerCompletionQueue>> cqs_;
+  std::vector<pthread_t> threads_;
 }; /* class CollectdServer */
 
 class CollectdClient final {
@@ -767,6 +940,15 @@ static int c_grpc_config(oconfig_item_t *ci) {
     } else if (!strcasecmp("Server", child->key)) {
       if (c_grpc_config_server(child))
         return -1;
+    } else if (!strcasecmp("Threads", child->key)) {
+      int threads = 0;
+      if (cf_util_get_int(child, &threads))
+        return -1;
+      if ((threads < 1) || (threads > 64)) {
+        ERROR("grpc: `%s` must be between 1 and 64.", child->key);
+        return -1;
+      }
+      worker_threads_num = (size_t)threads;
     }
 
     else {
@@ -784,7 +966,12 @@ static int c_grpc_init(void) {
     return -1;
   }
 
-  server->Start();
+  if (!server->Start()) {
+    server->Shutdown();
+    delete server;
+    server = nullptr;
+    return -1;
+  }
   return 0;
 } /* c_grpc_init() */
 
@@ -76,6 +76,10 @@ struct intel_pmu_ctx_s {
   core_groups_list_t cores;
   struct eventlist *event_list;
   bool dispatch_cloned_pmus;
+  bool group_events;
+  /* Buffer for reading a whole event group, see pmu_read_group(). */
+  uint64_t *group_buf;
+  size_t group_buf_size;
 };
 typedef struct intel_pmu_ctx_s intel_pmu_ctx_t;
 
@@ -150,13 +154,16 @@ event_info_t g_hw_cache_events[] = {
      .config = (PERF_COUNT_HW_CACHE_BPU | HW_CACHE_READ_MISS)},
 };
 
+/* The first entry leads the group if GroupEvents is enabled. Members of a
+ * group led by one of the hrtimer based clock events are not counted, so
+ * keep an event of the generic software PMU first. */
 event_info_t g_sw_events[] = {
+    {.name = "context-switches", .config = PERF_COUNT_SW_CONTEXT_SWITCHES},
+
     {.name = "cpu-clock", .config = PERF_COUNT_SW_CPU_CLOCK},
 
     {.name = "task-clock", .config = PERF_COUNT_SW_TASK_CLOCK},
 
-    {.name = "context-switches", .config = PERF_COUNT_SW_CONTEXT_SWITCHES},
-
     {.name = "cpu-migrations", .config = PERF_COUNT_SW_CPU_MIGRATIONS},
 
     {.name = "page-faults", .config = PERF_COUNT_SW_PAGE_FAULTS},
@@ -202,6 +209,7 @@ static void pmu_dump_config(void) {
   DEBUG(PMU_PLUGIN ":   hw_cache_events     : %d", g_ctx.hw_cache_events);
   DEBUG(PMU_PLUGIN ":   kernel_pmu_events   : %d", g_ctx.kernel_pmu_events);
   DEBUG(PMU_PLUGIN ":   software_events     : %d", g_ctx.sw_events);
+  DEBUG(PMU_PLUGIN ":   group_events        : %d", g_ctx.group_events);
 
   for (size_t i = 0; i < g_ctx.hw_events_count; i++) {
     DEBUG(PMU_PLUGIN ":   hardware_events[%" PRIsz "]  : %s", i,
@@ -329,6 +337,8 @@ static int pmu_config(oconfig_item_t *ci) {
       ret = config_cores_parse(child, &g_ctx.cores);
     } else if (strcasecmp("DispatchMultiPmu", child->key) == 0) {
       ret = cf_util_get_boolean(child, &g_ctx.dispatch_cloned_pmus);
+    } else if (strcasecmp("GroupEvents", child->key) == 0) {
+      ret = cf_util_get_boolean(child, &g_ctx.group_events);
     } else {
       ERROR(PMU_PLUGIN ": Unknown configuration parameter \"%s\".", child->key);
       ret = -1;
@@ -450,14 +460,52 @@ static void pmu_dispatch_data(void) {
   }
 }
 
+/* Reads the counters of all members of the group led by "leader" on "core"
+ * with a single read(2). The leader has been opened with PERF_FORMAT_GROUP,
+ * so the kernel returns the number of counters, the shared enabled and
+ * running times and the values of the members in the order they were added
+ * to the group. The values are stored in the members' efd the same way
+ * read_event() does, so that the scaling helpers keep working. */
+static int pmu_read_group(struct event *leader, int core) {
+  uint64_t *buf = g_ctx.group_buf;
+
+  ssize_t len = read(leader->efd[core].fd, buf, g_ctx.group_buf_size);
+  if (len < (ssize_t)(3 * sizeof(*buf)))
+    return -1;
+
+  uint64_t nr = buf[0];
+  if ((size_t)len < (3 + nr) * sizeof(*buf))
+    return -1;
+
+  uint64_t idx = 0;
+  for (struct event *e = leader; e != NULL; e = e->next) {
+    /* members which could not be added to the group are not reported */
+    if (e->efd[core].fd >= 0) {
+      if (idx >= nr)
+        return -1;
+      e->efd[core].val[0] = buf[3 + idx];
+      e->efd[core].val[1] = buf[1];
+      e->efd[core].val[2] = buf[2];
+      idx++;
+    }
+    if (e->end_group)
+      break;
+  }
+
+  return (idx == nr) ? 0 : -1;
+}
+
 static int pmu_read(__attribute__((unused)) user_data_t *ud) {
   int ret;
-  struct event *e;
+  struct event *e, *leader = NULL;
 
   DEBUG(PMU_PLUGIN ": %s:%d", __FUNCTION__, __LINE__);
 
   /* read all events only for configured cores */
   for (e = g_ctx.event_list->eventlist; e; e = e->next) {
+    if (e->group_leader)
+      leader = e;
+
     for (size_t i = 0; i < g_ctx.cores.num_cgroups; i++) {
       core_group_t *cgroup = g_ctx.cores.cgroups + i;
       for (size_t j = 0; j < cgroup->num_cores; j++) {
@@ -465,7 +513,16 @@ static int pmu_read(__attribute__((unused)) user_data_t *ud) {
         if (e->efd[core].fd < 0)
           continue;
 
-        ret = read_event(e, core);
+        /* Members of a group are read together with their leader. If the
+         * leader is not available on this core, the members have been set
+         * up as separate events. */
+        if (leader != NULL && leader->efd[core].fd >= 0) {
+          if (e != leader)
+            continue;
+          ret = pmu_read_group(leader, core);
+        } else {
+          ret = read_event(e, core);
+        }
         if (ret != 0) {
           ERROR(PMU_PLUGIN ": Failed to read value of %s/%d event.", e->event,
                 core);
@@ -473,6 +530,9 @@ static int pmu_read(__attribute__((unused)) user_data_t *ud) {
         }
       }
     }
+
+    if (e->end_group)
+      leader = NULL;
   }
 
   pmu_dispatch_data();
@@ -481,7 +541,7 @@ static int pmu_read(__attribute__((unused)) user_data_t *ud) {
 }
 
 static int pmu_add_events(struct eventlist *el, uint32_t type,
-                          event_info_t *events, size_t count) {
+                          event_info_t *events, size_t count, bool group) {
 
   for (size_t i = 0; i < count; i++) {
     /* Allocate memory for event struct that contains array of efd structs
@@ -492,6 +552,14 @@ static int pmu_add_events(struct eventlist *el, uint32_t type,
       ERROR(PMU_PLUGIN ": Failed to allocate event structure");
       return -ENOMEM;
     }
+    for (size_t j = 0; j < el->num_cpus; j++)
+      e->efd[j].fd = -1;
+
+    if (group) {
+      e->group_leader = (i == 0);
+      e->end_group = (i == count - 1);
+      e->ingroup = 1;
+    }
 
     e->attr.type = type;
     e->attr.config = events[i].config;
@@ -633,10 +701,20 @@ static void pmu_free_events(struct eventlist *el) {
 static int pmu_setup_events(struct eventlist *el, bool measure_all,
                             int measure_pid) {
   struct event *e, *leader = NULL;
+  size_t group_size = 0, max_group_size = 0;
   int ret = -1;
 
   for (e = el->eventlist; e; e = e->next) {
 
+    if (e->group_leader) {
+      /* read the whole group with one read(2), see pmu_read_group() */
+      e->attr.read_format |= PERF_FORMAT_TOTAL_TIME_ENABLED |
+                             PERF_FORMAT_TOTAL_TIME_RUNNING | PERF_FORMAT_GROUP;
+      group_size = 0;
+    }
+    if (e->ingroup && (++group_size > max_group_size))
+      max_group_size = group_size;
+
     for (size_t i = 0; i < g_ctx.cores.num_cgroups; i++) {
       core_group_t *cgroup = g_ctx.cores.cgroups + i;
       for (size_t j = 0; j < cgroup->num_cores; j++) {
@@ -669,6 +747,15 @@ static int pmu_setup_events(struct eventlist *el, bool measure_all,
       leader = NULL;
   }
 
+  if (max_group_size > 0) {
+    g_ctx.group_buf_size = (3 + max_group_size) * sizeof(*g_ctx.group_buf);
+    g_ctx.group_buf = calloc(1, g_ctx.group_buf_size);
+    if (g_ctx.group_buf == NULL) {
+      ERROR(PMU_PLUGIN ": Failed to allocate group read buffer.");
+      return -ENOMEM;
+    }
+  }
+
   return ret;
 }
 
@@ -702,9 +789,10 @@ static int pmu_init(void) {
 #endif
 
   if (g_ctx.hw_cache_events) {
-    ret =
-        pmu_add_events(g_ctx.event_list, PERF_TYPE_HW_CACHE, g_hw_cache_events,
-                       STATIC_ARRAY_SIZE(g_hw_cache_events));
+    ret = pmu_add_events(g_ctx.event_list, PERF_TYPE_HW_CACHE,
+                         g_hw_cache_events,
+                         STATIC_ARRAY_SIZE(g_hw_cache_events),
+                         g_ctx.group_events);
     if (ret != 0) {
       ERROR(PMU_PLUGIN ": Failed to add hw cache events.");
       goto init_error;
@@ -714,7 +802,8 @@ static int pmu_init(void) {
   if (g_ctx.kernel_pmu_events) {
     ret = pmu_add_events(g_ctx.event_list, PERF_TYPE_HARDWARE,
                          g_kernel_pmu_events,
-                         STATIC_ARRAY_SIZE(g_kernel_pmu_events));
+                         STATIC_ARRAY_SIZE(g_kernel_pmu_events),
+                         g_ctx.group_events);
     if (ret != 0) {
       ERROR(PMU_PLUGIN ": Failed to add kernel PMU events.");
       goto init_error;
@@ -741,7 +830,7 @@ static int pmu_init(void) {
 
   if (g_ctx.sw_events) {
     ret = pmu_add_events(g_ctx.event_list, PERF_TYPE_SOFTWARE, g_sw_events,
-                         STATIC_ARRAY_SIZE(g_sw_events));
+                         STATIC_ARRAY_SIZE(g_sw_events), g_ctx.group_events);
     if (ret != 0) {
       ERROR(PMU_PLUGIN ": Failed to add software events.");
       goto init_error;
@@ -770,6 +859,8 @@ init_error:
 
   pmu_free_events(g_ctx.event_list);
   g_ctx.event_list = NULL;
+  sfree(g_ctx.group_buf);
+  g_ctx.group_buf_size = 0;
   for (size_t i = 0; i < g_ctx.hw_events_count; i++) {
     sfree(g_ctx.hw_events[i]);
   }
@@ -787,6 +878,8 @@ static int pmu_shutdown(void) {
 
   pmu_free_events(g_ctx.event_list);
   g_ctx.event_list = NULL;
+  sfree(g_ctx.group_buf);
+  g_ctx.group_buf_size = 0;
   for (size_t i = 0; i < g_ctx.hw_events_count; i++) {
     sfree(g_ctx.hw_events[i]);
   }
@@ -84,6 +84,7 @@ struct rdt_ctx_s {
   size_t num_ngroups;
   proc_pids_t **proc_pids;
   size_t num_proc_pids;
+  proc_pids_monitor_t *pids_monitor;
 #endif /* LIBPQOS2 */
   const struct pqos_cpuinfo *pqos_cpu;
   const struct pqos_cap *pqos_cap;
@@ -503,6 +504,10 @@ static void rdt_free_ngroups(rdt_ctx_t *rdt) {
   }
   if (rdt->proc_pids)
     sfree(rdt->proc_pids);
+  rdt->num_proc_pids = 0;
+
+  proc_pids_monitor_destroy(rdt->pids_monitor);
+  rdt->pids_monitor = NULL;
 
   rdt->num_ngroups = 0;
 }
@@ -753,6 +758,26 @@ cleanup:
   return result;
 }
 
+/*
+ * NAME
+ *   rdt_update_proc_pids
+ *
+ * DESCRIPTION
+ *   Updates PIDs of all monitored process names, from process events if
+ *   the proc connector is available and by scanning /proc otherwise.
+ *
+ * RETURN VALUE
+ *  0 on success. Negative number on error.
+ */
+static int rdt_update_proc_pids(void) {
+  if (g_rdt->pids_monitor != NULL)
+    return proc_pids_monitor_update(g_rdt->pids_monitor, g_rdt->proc_pids,
+                                    g_rdt->num_proc_pids);
+
+  return proc_pids_update(RDT_PROC_PATH, g_rdt->proc_pids,
+                          g_rdt->num_proc_pids);
+}
+
 /*
  * NAME
  *   read_pids_data
@@ -810,7 +835,7 @@ static int read_pids_data() {
 #endif /* COLLECT_DEBUG */
 
 groups_refresh:
-  ret = proc_pids_update(RDT_PROC_PATH, g_rdt->proc_pids, g_rdt->num_proc_pids);
+  ret = rdt_update_proc_pids();
   if (0 != ret) {
     ERROR(RDT_PLUGIN ": Initial update of proc pids failed");
     return ret;
@@ -877,8 +902,12 @@ static void rdt_init_pids_monitoring() {
   }
 
   if (g_rdt->num_ngroups > 0) {
-    int update_result =
-        proc_pids_update(RDT_PROC_PATH, g_rdt->proc_pids, g_rdt->num_proc_pids);
+    g_rdt->pids_monitor = proc_pids_monitor_create(RDT_PROC_PATH);
+    if (g_rdt->pids_monitor == NULL)
+      INFO(RDT_PLUGIN ": Process events are not available, "
+                      "scanning " RDT_PROC_PATH " on every read instead.");
+
+    int update_result = rdt_update_proc_pids();
     if (0 != update_result)
       ERROR(RDT_PLUGIN ": Initial update of proc pids failed");
   }
@@ -55,6 +55,13 @@
 #include <sys/protosw.h>
 #endif
 
+#if KERNEL_LINUX && HAVE_LIBRTNL
+#include "utils/avltree/avltree.h"
+#include "utils/rtnl/rtnl.h"
+
+#include <linux/if_link.h>
+#endif
+
 /*
  * Various people have reported problems with `getifaddrs' and varying versions
  * of `glibc'. That's why it's disabled by default. Since more statistics are
@@ -103,6 +110,30 @@ static int numif;
 static bool unique_name;
 #endif /* HAVE_LIBKSTAT */
 
+#if KERNEL_LINUX && HAVE_LIBRTNL
+/* Number of value lists handed to the daemon at once. */
+#define IF_DISPATCH_BATCH 256
+
+/* Interfaces seen in previous dumps, keyed by ifindex. Caches the result of
+ * the ignorelist lookup. */
+typedef struct {
+  int ifindex;
+  char name[DATA_MAX_NAME_LEN];
+  bool ignored;
+  uint64_t generation;
+} if_entry_t;
+
+typedef struct {
+  value_list_t vls[IF_DISPATCH_BATCH];
+  value_t values[IF_DISPATCH_BATCH][2];
+  size_t num;
+} if_batch_t;
+
+static struct mnl_socket *if_nl;
+static c_avl_tree_t *if_entries;
+static uint64_t if_generation;
+#endif /* KERNEL_LINUX && HAVE_LIBRTNL */
+
 static int interface_config(const char *key, const char *value) {
   if (ignorelist == NULL)
     ignorelist = ignorelist_create(/* invert = */ 1);
@@ -159,6 +190,48 @@ static int interface_init(void) {
 } /* int interface_init */
 #endif /* HAVE_LIBKSTAT */
 
+#if KERNEL_LINUX && HAVE_LIBRTNL
+static int if_entry_compare(const void *a, const void *b) {
+  int ia = *(const int *)a;
+  int ib = *(const int *)b;
+  return (ia > ib) - (ia < ib);
+} /* int if_entry_compare */
+
+static int interface_init(void) {
+  if_entries = c_avl_create(if_entry_compare);
+  if (if_entries == NULL) {
+    ERROR("interface plugin: c_avl_create failed.");
+    return -1;
+  }
+
+  /* Without a netlink socket, /proc/net/dev is parsed instead. */
+  if_nl = rtnl_open();
+  if (if_nl == NULL)
+    WARNING("interface plugin: Opening a netlink socket failed. Falling back "
+            "to reading /proc/net/dev.");
+
+  return 0;
+} /* int interface_init */
+
+static int interface_shutdown(void) {
+  if (if_nl != NULL) {
+    mnl_socket_close(if_nl);
+    if_nl = NULL;
+  }
+
+  if (if_entries != NULL) {
+    void *key;
+    void *value;
+    while (c_avl_pick(if_entries, &key, &value) == 0)
+      sfree(value);
+    c_avl_destroy(if_entries);
+    if_entries = NULL;
+  }
+
+  return 0;
+} /* int interface_shutdown */
+#endif /* KERNEL_LINUX && HAVE_LIBRTNL */
+
 static void if_submit(const char *dev, const char *type, derive_t rx,
                       derive_t tx) {
   value_list_t vl = VALUE_LIST_INIT;
@@ -179,6 +252,159 @@ static void if_submit(const char *dev, const char *type, derive_t rx,
   plugin_dispatch_values(&vl);
 } /* void if_submit */
 
+#if KERNEL_LINUX && HAVE_LIBRTNL
+static void if_batch_flush(if_batch_t *b) {
+  if (b->num == 0)
+    return;
+
+  plugin_dispatch_value_lists(b->vls, b->num);
+  b->num = 0;
+} /* void if_batch_flush */
+
+static void if_batch_add(if_batch_t *b, if_entry_t const *e, const char *type,
+                         derive_t rx, derive_t tx) {
+  value_list_t *vl = b->vls + b->num;
+
+  b->values[b->num][0].derive = rx;
+  b->values[b->num][1].derive = tx;
+
+  *vl = (value_list_t)VALUE_LIST_INIT;
+  vl->values = b->values[b->num];
+  vl->values_len = 2;
+  sstrncpy(vl->plugin, "interface", sizeof(vl->plugin));
+  sstrncpy(vl->plugin_instance, e->name, sizeof(vl->plugin_instance));
+  sstrncpy(vl->type, type, sizeof(vl->type));
+
+  b->num++;
+  if (b->num == IF_DISPATCH_BATCH)
+    if_batch_flush(b);
+} /* void if_batch_add */
+
+static if_entry_t *if_entry_get(rtnl_link_t const *link) {
+  if_entry_t *e = NULL;
+
+  if (c_avl_get(if_entries, &link->ifindex, (void *)&e) != 0) {
+    e = calloc(1, sizeof(*e));
+    if (e == NULL) {
+      ERROR("interface plugin: calloc failed.");
+      return NULL;
+    }
+    e->ifindex = link->ifindex;
+    if (c_avl_insert(if_entries, &e->ifindex, e) != 0) {
+      ERROR("interface plugin: c_avl_insert failed.");
+      sfree(e);
+      return NULL;
+    }
+  } else if (strcmp(e->name, link->name) == 0) {
+    e->generation = if_generation;
+    return e;
+  }
+
+  /* New or renamed interface. */
+  sstrncpy(e->name, link->name, sizeof(e->name));
+  e->ignored = (ignorelist_match(ignorelist, e->name) != 0);
+  e->generation = if_generation;
+  return e;
+} /* if_entry_t *if_entry_get */
+
+static int if_link_cb(rtnl_link_t const *link, void *arg) {
+  if_batch_t *b = arg;
+  derive_t rx_packets, tx_packets, rx_bytes, tx_bytes;
+  derive_t rx_errors, tx_errors, rx_dropped, tx_dropped;
+
+  if_entry_t *e = if_entry_get(link);
+  if ((e == NULL) || e->ignored)
+    return 0;
+
+  /* The "drop" column of /proc/net/dev includes rx_missed_errors. */
+  if (link->stats64 != NULL) {
+    rx_packets = link->stats64->rx_packets;
+    tx_packets = link->stats64->tx_packets;
+    rx_bytes = link->stats64->rx_bytes;
+    tx_bytes = link->stats64->tx_bytes;
+    rx_errors = link->stats64->rx_errors;
+    tx_errors = link->stats64->tx_errors;
+    rx_dropped =
+        link->stats64->rx_dropped + link->stats64->rx_missed_errors;
+    tx_dropped = link->stats64->tx_dropped;
+  } else if (link->stats32 != NULL) {
+    rx_packets = link->stats32->rx_packets;
+    tx_packets = link->stats32->tx_packets;
+    rx_bytes = link->stats32->rx_bytes;
+    tx_bytes = link->stats32->tx_bytes;
+    rx_errors = link->stats32->rx_errors;
+    tx_errors = link->stats32->tx_errors;
+    rx_dropped =
+        link->stats32->rx_dropped + link->stats32->rx_missed_errors;
+    tx_dropped = link->stats32->tx_dropped;
+  } else {
+    return 0;
+  }
+
+  if (!report_inactive && rx_packets == 0 && tx_packets == 0)
+    return 0;
+
+  if_batch_add(b, e, "if_packets", rx_packets, tx_packets);
+  if_batch_add(b, e, "if_octets", rx_bytes, tx_bytes);
+  if_batch_add(b, e, "if_errors", rx_errors, tx_errors);
+  if_batch_add(b, e, "if_dropped", rx_dropped, tx_dropped);
+
+  return 0;
+} /* int if_link_cb */
+
+/* Removes the entries of interfaces that were not part of the last dump. */
+static void if_entries_prune(void) {
+  if_entry_t **stale = NULL;
+  size_t stale_num = 0;
+  size_t stale_size = 0;
+  void *key;
+  void *value;
+
+  /* The tree must not be changed while iterating. */
+  c_avl_iterator_t *iter = c_avl_get_iterator(if_entries);
+  while (c_avl_iterator_next(iter, &key, &value) == 0) {
+    if_entry_t *e = value;
+    if (e->generation == if_generation)
+      continue;
+
+    if (stale_num == stale_size) {
+      size_t new_size = (stale_size == 0) ? 16 : 2 * stale_size;
+      if_entry_t **tmp = realloc(stale, new_size * sizeof(*stale));
+      if (tmp == NULL)
+        break;
+      stale = tmp;
+      stale_size = new_size;
+    }
+    stale[stale_num++] = e;
+  }
+  c_avl_iterator_destroy(iter);
+
+  for (size_t i = 0; i < stale_num; i++) {
+    c_avl_remove(if_entries, &stale[i]->ifindex, NULL, NULL);
+    sfree(stale[i]);
+  }
+  sfree(stale);
+} /* void if_entries_prune */
+
+static int interface_read_netlink(void) {
+  static if_batch_t batch;
+  char buf[MNL_SOCKET_BUFFER_SIZE];
+  int status;
+
+  if_generation++;
+  batch.num = 0;
+
+  status = rtnl_link_dump(if_nl, buf, sizeof(buf), /* ext_mask = */ 0,
+                          if_link_cb, &batch);
+  if_batch_flush(&batch);
+  if (status != 0)
+    return status;
+
+  if_entries_prune();
+  return 0;
+} /* int interface_read_netlink */
+#endif /* KERNEL_LINUX && HAVE_LIBRTNL */
+
 static int interface_read(void) {
 #if KERNEL_LINUX
   FILE *fh;
@@ -190,6 +416,11 @@ static int interface_read(void) {
   char *fields[16];
   int numfields;
 
+#if HAVE_LIBRTNL
+  if (if_nl != NULL)
+    return interface_read_netlink();
+#endif
+
   if ((fh = fopen("/proc/net/dev", "r")) == NULL) {
     WARNING("interface plugin: fopen: %s", STRERRNO);
     return -1;
@@ -393,8 +624,11 @@ static int interface_read(void) {
 void module_register(void) {
   plugin_register_config("interface", interface_config, config_keys,
                          config_keys_num);
-#if HAVE_LIBKSTAT
+#if HAVE_LIBKSTAT || (KERNEL_LINUX && HAVE_LIBRTNL)
   plugin_register_init("interface", interface_init);
+#endif
+#if KERNEL_LINUX && HAVE_LIBRTNL
+  plugin_register_shutdown("interface", interface_shutdown);
 #endif
   plugin_register_read("interface", interface_read);
 } /* void module_register */
@@ -68,8 +68,13 @@ struct c_ipmi_instance_s {
   pthread_mutex_t sensor_list_lock;
   c_ipmi_sensor_list_t *sensor_list;
 
+  /* Copies of the readings, dispatched by c_ipmi_read() after releasing
+   * `sensor_list_lock'. */
+  value_list_t *snapshot;
+  value_t *snapshot_values;
+  size_t snapshot_size;
+
   bool active;
-  pthread_t thread_id;
   int init_in_progress;
 
   struct c_ipmi_instance_s *next;
@@ -85,6 +90,11 @@ struct c_ipmi_sensor_list_s {
   c_ipmi_sensor_list_t *next;
   c_ipmi_instance_t *instance;
   unsigned int use;
+
+  /* Last reading, stored by sensor_read_handler(). */
+  gauge_t value;
+  cdtime_t value_time;
+  cdtime_t dispatched_time;
 };
 
 struct c_ipmi_db_type_map_s {
@@ -99,6 +109,18 @@ typedef struct c_ipmi_db_type_map_s c_ipmi_db_type_map_t;
 static os_handler_t *os_handler;
 static c_ipmi_instance_t *instances;
 
+/* All instances share one OpenIPMI event loop, run by `event_threads_num'
+ * threads. */
+static int event_threads_num = 1;
+static pthread_t *event_threads;
+static size_t event_threads_started;
+static bool event_loop_active;
+
+/* File the SDR repositories of all instances are cached in. OpenIPMI only
+ * fetches the SDRs from the BMC again when the repository's timestamps
+ * differ from the cached ones. */
+static char *sdr_cache_file;
+
 /*
  * Misc private functions
  */
@@ -173,17 +195,19 @@ static notification_t c_ipmi_notification_init(c_ipmi_instance_t const *st,
 /* Prototype for sensor_list_remove, so sensor_read_handler can call it. */
 static int sensor_list_remove(c_ipmi_instance_t *st, ipmi_sensor_t *sensor);
 
+/* Stores the reading in the sensor list. The readings are dispatched by the
+ * next c_ipmi_read(), so that slow BMCs never block a read callback. */
 static void sensor_read_handler(ipmi_sensor_t *sensor, int err,
                                 enum ipmi_value_present_e value_present,
                                 unsigned int __attribute__((unused)) raw_value,
                                 double value, ipmi_states_t *states,
                                 void *user_data) {
-  value_list_t vl = VALUE_LIST_INIT;
-
   c_ipmi_sensor_list_t *list_item = user_data;
   c_ipmi_instance_t *st = list_item->instance;
 
+  pthread_mutex_lock(&st->sensor_list_lock);
   list_item->use--;
+  pthread_mutex_unlock(&st->sensor_list_lock);
 
   if (err != 0) {
     if (IPMI_IS_IPMI_ERR(err) &&
@@ -286,17 +310,10 @@ static void sensor_read_handler(ipmi_sensor_t *sensor, int err,
     return;
   }
 
-  vl.values = &(value_t){.gauge = value};
-  vl.values_len = 1;
-
-  if (st->host != NULL)
-    sstrncpy(vl.host, st->host, sizeof(vl.host));
-  sstrncpy(vl.plugin, "ipmi", sizeof(vl.plugin));
-  sstrncpy(vl.type, list_item->sensor_type, sizeof(vl.type));
-  sstrncpy(vl.type_instance, list_item->type_instance,
-           sizeof(vl.type_instance));
-
-  plugin_dispatch_values(&vl);
+  pthread_mutex_lock(&st->sensor_list_lock);
+  list_item->value = value;
+  list_item->value_time = cdtime();
+  pthread_mutex_unlock(&st->sensor_list_lock);
 } /* void sensor_read_handler */
 
 static void sensor_get_name(ipmi_sensor_t *sensor, char *buffer, int buf_len) {
@@ -572,9 +589,63 @@ static int sensor_list_remove(c_ipmi_instance_t *st, ipmi_sensor_t *sensor) {
   return 0;
 } /* int sensor_list_remove */
 
+/* Copies the readings that arrived since the last call to st->snapshot and
+ * requests new ones. Returns the number of readings copied, or -1 on error.
+ * Must be called with `sensor_list_lock' held. */
+static int sensor_list_snapshot(c_ipmi_instance_t *st) {
+  size_t num = 0;
+  for (c_ipmi_sensor_list_t *list_item = st->sensor_list; list_item != NULL;
+       list_item = list_item->next)
+    num++;
+
+  if (num > st->snapshot_size) {
+    value_list_t *vls = realloc(st->snapshot, num * sizeof(*vls));
+    if (vls == NULL)
+      return -1;
+    st->snapshot = vls;
+
+    value_t *values = realloc(st->snapshot_values, num * sizeof(*values));
+    if (values == NULL)
+      return -1;
+    st->snapshot_values = values;
+    st->snapshot_size = num;
+  }
+
+  int copied = 0;
+  for (c_ipmi_sensor_list_t *list_item = st->sensor_list; list_item != NULL;
+       list_item = list_item->next) {
+    if (list_item->value_time <= list_item->dispatched_time)
+      continue;
+
+    value_list_t *vl = st->snapshot + copied;
+    *vl = (value_list_t)VALUE_LIST_INIT;
+
+    st->snapshot_values[copied].gauge = list_item->value;
+    vl->values = st->snapshot_values + copied;
+    vl->values_len = 1;
+    vl->time = list_item->value_time;
+
+    if (st->host != NULL)
+      sstrncpy(vl->host, st->host, sizeof(vl->host));
+    sstrncpy(vl->plugin, "ipmi", sizeof(vl->plugin));
+    sstrncpy(vl->type, list_item->sensor_type, sizeof(vl->type));
+    sstrncpy(vl->type_instance, list_item->type_instance,
+             sizeof(vl->type_instance));
+
+    list_item->dispatched_time = list_item->value_time;
+    copied++;
+  }
+
+  return copied;
+} /* int sensor_list_snapshot */
+
 static int sensor_list_read_all(c_ipmi_instance_t *st) {
   pthread_mutex_lock(&st->sensor_list_lock);
 
+  int num = sensor_list_snapshot(st);
+  if (num < 0)
+    ERROR("ipmi plugin: Copying the readings of `%s` failed.", st->name);
+
   for (c_ipmi_sensor_list_t *list_item = st->sensor_list; list_item != NULL;
        list_item = list_item->next) {
     DEBUG("ipmi plugin: try read sensor `%s` of `%s`, use: %d",
@@ -591,6 +662,11 @@ static int sensor_list_read_all(c_ipmi_instance_t *st) {
 
   pthread_mutex_unlock(&st->sensor_list_lock);
 
+  /* Only c_ipmi_read() uses the snapshot, and reads of the same instance
+   * never run concurrently. */
+  if (num > 0)
+    plugin_dispatch_value_lists(st->snapshot, (size_t)num);
+
   return 0;
 } /* int sensor_list_read_all */
 
@@ -922,7 +998,7 @@ static void domain_connection_change_handler(ipmi_domain_t *domain, int err,
     c_ipmi_error(st, "Failed to register smi event handler", status);
 } /* void domain_connection_change_handler */
 
-static int c_ipmi_thread_init(c_ipmi_instance_t *st) {
+static int c_ipmi_instance_connect(c_ipmi_instance_t *st) {
   ipmi_domain_id_t domain_id;
   int status;
 
@@ -948,8 +1024,10 @@ static int c_ipmi_thread_init(c_ipmi_instance_t *st) {
   ipmi_open_option_t opts[] = {
       {.option = IPMI_OPEN_OPTION_ALL, {.ival = 1}},
 #ifdef IPMI_OPEN_OPTION_USE_CACHE
-      /* OpenIPMI-2.0.17 and later: Disable SDR cache in local file */
-      {.option = IPMI_OPEN_OPTION_USE_CACHE, {.ival = 0}},
+      /* OpenIPMI-2.0.17 and later: Use the SDR cache only if a file was
+       * configured. */
+      {.option = IPMI_OPEN_OPTION_USE_CACHE,
+       {.ival = (sdr_cache_file != NULL) ? 1 : 0}},
 #endif
   };
 
@@ -968,24 +1046,17 @@ static int c_ipmi_thread_init(c_ipmi_instance_t *st) {
   }
 
   return 0;
-} /* int c_ipmi_thread_init */
-
-static void *c_ipmi_thread_main(void *user_data) {
-  c_ipmi_instance_t *st = user_data;
-
-  int status = c_ipmi_thread_init(st);
-  if (status != 0) {
-    ERROR("ipmi plugin: c_ipmi_thread_init failed.");
-    st->active = false;
-    return (void *)-1;
-  }
+} /* int c_ipmi_instance_connect */
 
-  while (st->active) {
+/* Runs the event loop shared by all instances. OpenIPMI's POSIX thread OS
+ * handler lets any number of threads do so. */
+static void *c_ipmi_event_loop(__attribute__((unused)) void *user_data) {
+  while (event_loop_active) {
     struct timeval tv = {1, 0};
     os_handler->perform_one_op(os_handler, &tv);
   }
   return (void *)0;
-} /* void *c_ipmi_thread_main */
+} /* void *c_ipmi_event_loop */
 
 static c_ipmi_instance_t *c_ipmi_init_instance() {
   c_ipmi_instance_t *st;
@@ -1049,6 +1120,8 @@ static void c_ipmi_free_instance(c_ipmi_instance_t *st) {
   ignorelist_free(st->sel_ignorelist);
   ignorelist_free(st->ignorelist);
   pthread_mutex_destroy(&st->sensor_list_lock);
+  sfree(st->snapshot);
+  sfree(st->snapshot_values);
   sfree(st);
 } /* void c_ipmi_free_instance */
 
@@ -1083,6 +1156,11 @@ static int c_ipmi_config_add_instance(oconfig_item_t *ci) {
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
 
+    /* Legacy configuration: global options are in the same block. */
+    if ((strcasecmp("Threads", child->key) == 0) ||
+        (strcasecmp("SDRCacheFile", child->key) == 0))
+      continue;
+
     if (strcasecmp("Sensor", child->key) == 0) {
       char *value = NULL;
       status = cf_util_get_string(child, &value);
@@ -1165,10 +1243,30 @@ static int c_ipmi_config_add_instance(oconfig_item_t *ci) {
 static int c_ipmi_config(oconfig_item_t *ci) {
   bool have_instance_block = 0;
 
+  for (int i = 0; i < ci->children_num; i++) {
+    oconfig_item_t *child = ci->children + i;
+    int status = 0;
+
+    if (strcasecmp("Threads", child->key) == 0) {
+      status = cf_util_get_int(child, &event_threads_num);
+      if ((status == 0) && (event_threads_num < 1)) {
+        ERROR("ipmi plugin: \"Threads\" must be positive.");
+        status = -1;
+      }
+    } else if (strcasecmp("SDRCacheFile", child->key) == 0) {
+      status = cf_util_get_string(child, &sdr_cache_file);
+    }
+    if (status != 0)
+      return status;
+  }
+
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
 
-    if (strcasecmp("Instance", child->key) == 0) {
+    if ((strcasecmp("Threads", child->key) == 0) ||
+        (strcasecmp("SDRCacheFile", child->key) == 0)) {
+      continue;
+    } else if (strcasecmp("Instance", child->key) == 0) {
       int status = c_ipmi_config_add_instance(child);
       if (status != 0)
         return status;
@@ -1237,6 +1335,45 @@ static int c_ipmi_init(void) {
     return -1;
   };
 
+  if (sdr_cache_file != NULL) {
+#ifdef IPMI_OPEN_OPTION_USE_CACHE
+    int status = ENOTSUP;
+    if (os_handler->database_set_filename != NULL)
+      status = os_handler->database_set_filename(os_handler, sdr_cache_file);
+    if (status != 0) {
+      WARNING("ipmi plugin: Unable to use \"%s\" as the SDR cache: %s",
+              sdr_cache_file, STRERROR(status));
+      sfree(sdr_cache_file);
+    }
+#else
+    WARNING("ipmi plugin: \"SDRCacheFile\" requires OpenIPMI 2.0.17 or "
+            "later.");
+    sfree(sdr_cache_file);
+#endif
+  }
+
+  event_threads = calloc((size_t)event_threads_num, sizeof(*event_threads));
+  if (event_threads == NULL) {
+    ERROR("ipmi plugin: calloc failed.");
+    return -1;
+  }
+
+  event_loop_active = true;
+  for (int i = 0; i < event_threads_num; i++) {
+    int status = plugin_thread_create(event_threads + event_threads_started,
+                                      c_ipmi_event_loop,
+                                      /* user data = */ NULL, "ipmi");
+    if (status != 0) {
+      ERROR("ipmi plugin: pthread_create failed: %s", STRERROR(status));
+      break;
+    }
+    event_threads_started++;
+  }
+  if (event_threads_started == 0) {
+    event_loop_active = false;
+    return -1;
+  }
+
   if (instances == NULL) {
     /* No instances were configured, let's start a default instance. */
     st = c_ipmi_init_instance();
@@ -1275,16 +1412,14 @@ static int c_ipmi_init(void) {
     st->init_in_progress = cycles;
     st->active = true;
 
-    status = plugin_thread_create(&st->thread_id, c_ipmi_thread_main,
-                                  /* user data = */ (void *)st, "ipmi");
-
+    status = c_ipmi_instance_connect(st);
     if (status != 0) {
       st->active = false;
-      st->thread_id = (pthread_t){0};
 
       plugin_unregister_read(callback_name);
 
-      ERROR("ipmi plugin: pthread_create failed for `%s`.", callback_name);
+      ERROR("ipmi plugin: c_ipmi_instance_connect failed for `%s`.",
+            callback_name);
     }
 
     st = st->next;
@@ -1297,25 +1432,29 @@ static int c_ipmi_shutdown(void) {
   c_ipmi_instance_t *st = instances;
   instances = NULL;
 
+  event_loop_active = false;
+  for (size_t i = 0; i < event_threads_started; i++)
+    pthread_join(event_threads[i], NULL);
+  sfree(event_threads);
+  event_threads_started = 0;
+
   while (st != NULL) {
     c_ipmi_instance_t *next = st->next;
 
     st->next = NULL;
     st->active = false;
 
-    if (!pthread_equal(st->thread_id, (pthread_t){0})) {
-      pthread_join(st->thread_id, NULL);
-      st->thread_id = (pthread_t){0};
-    }
-
     sensor_list_remove_all(st);
     c_ipmi_free_instance(st);
 
     st = next;
   }
 
-  os_handler->free_os_handler(os_handler);
-  os_handler = NULL;
+  if (os_handler != NULL) {
+    os_handler->free_os_handler(os_handler);
+    os_handler = NULL;
+  }
+  sfree(sdr_cache_file);
 
   return 0;
 } /* int c_ipmi_shutdown */
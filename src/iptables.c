@@ -32,6 +32,16 @@
 #include <libiptc/libip6tc.h>
 #include <libiptc/libiptc.h>
 
+#if HAVE_LIBNFTNL
+#include <libmnl/libmnl.h>
+#include <libnftnl/common.h>
+#include <libnftnl/expr.h>
+#include <libnftnl/rule.h>
+#include <libnftnl/udata.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#endif
+
 #ifdef HAVE_SYS_CAPABILITY_H
 #include <sys/capability.h>
 #endif
@@ -61,11 +71,12 @@ typedef struct ip6tc_handle ip6tc_handle_t;
 
 /*
  * Config format should be `Chain table chainname',
- * e. g. `Chain mangle incoming'
+ * e. g. `Chain mangle incoming', or `NFTChain family table chainname' for
+ * nftables, e. g. `NFTChain inet filter input'.
  */
-static const char *config_keys[] = {"Chain", "Chain6"};
+static const char *config_keys[] = {"Chain", "Chain6", "NFTChain"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
-enum protocol_version_e { IPV4, IPV6 };
+enum protocol_version_e { IPV4, IPV6, NFT };
 typedef enum protocol_version_e protocol_version_t;
 
 /*
@@ -74,10 +85,13 @@ typedef enum protocol_version_e protocol_version_t;
 #ifndef XT_TABLE_MAXNAMELEN
 #define XT_TABLE_MAXNAMELEN 32
 #endif
+/* nftables allows much longer names than the legacy tables do. */
+#define IPT_NAME_MAXLEN DATA_MAX_NAME_LEN
 typedef struct {
   protocol_version_t ip_version;
-  char table[XT_TABLE_MAXNAMELEN];
-  char chain[XT_TABLE_MAXNAMELEN];
+  int family; /* NFPROTO_* of the table, nftables only */
+  char table[IPT_NAME_MAXLEN];
+  char chain[IPT_NAME_MAXLEN];
   union {
     int num;
     char *comment;
@@ -89,15 +103,56 @@ typedef struct {
 static ip_chain_t **chain_list;
 static int chain_num;
 
+#if HAVE_LIBNFTNL
+static struct mnl_socket *nft_sock;
+static uint32_t nft_portid;
+static uint32_t nft_seq;
+
+/* Type of the rule comment in the rule's user data, as used by nft(8). */
+#define NFT_UDATA_RULE_COMMENT 0
+
+static const struct {
+  const char *name;
+  int family;
+} nft_families[] = {
+    {"ip", NFPROTO_IPV4},     {"ip6", NFPROTO_IPV6},
+    {"inet", NFPROTO_INET},   {"arp", NFPROTO_ARP},
+    {"bridge", NFPROTO_BRIDGE}, {"netdev", NFPROTO_NETDEV},
+};
+
+static const char *nft_family_name(int family) {
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(nft_families); i++)
+    if (nft_families[i].family == family)
+      return nft_families[i].name;
+  return "unknown";
+} /* const char *nft_family_name */
+
+static int nft_family_parse(const char *name) {
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(nft_families); i++)
+    if (strcasecmp(nft_families[i].name, name) == 0)
+      return nft_families[i].family;
+  return -1;
+} /* int nft_family_parse */
+#endif /* HAVE_LIBNFTNL */
+
 static int iptables_config(const char *key, const char *value) {
   /* int ip_value; */
   protocol_version_t ip_version = 0;
+  size_t name_maxlen = XT_TABLE_MAXNAMELEN;
 
   if (strcasecmp(key, "Chain") == 0)
     ip_version = IPV4;
   else if (strcasecmp(key, "Chain6") == 0)
     ip_version = IPV6;
-  else
+  else if (strcasecmp(key, "NFTChain") == 0) {
+#if HAVE_LIBNFTNL
+    ip_version = NFT;
+    name_maxlen = IPT_NAME_MAXLEN;
+#else
+    ERROR("iptables plugin: NFTChain: collectd was built without libnftnl.");
+    return 1;
+#endif
+  } else
     return 1;
 
   ip_chain_t temp = {0};
@@ -106,7 +161,8 @@ static int iptables_config(const char *key, const char *value) {
   char *chain;
 
   char *value_copy;
-  char *fields[4];
+  char *fields_buf[5];
+  char **fields = fields_buf;
   int fields_num;
 
   value_copy = strdup(value);
@@ -124,8 +180,27 @@ static int iptables_config(const char *key, const char *value) {
   /* set IPv4 or IPv6 */
   temp.ip_version = ip_version;
 
-  /* Chain <table> <chain> [<comment|num> [name]] */
-  fields_num = strsplit(value_copy, fields, 4);
+  /* Chain <table> <chain> [<comment|num> [name]]
+   * NFTChain <family> <table> <chain> [<comment|num> [name]] */
+  fields_num = strsplit(value_copy, fields_buf, STATIC_ARRAY_SIZE(fields_buf));
+#if HAVE_LIBNFTNL
+  if (ip_version == NFT) {
+    if (fields_num < 3) {
+      free(value_copy);
+      return 1;
+    }
+
+    temp.family = nft_family_parse(fields[0]);
+    if (temp.family < 0) {
+      ERROR("iptables plugin: Unknown nftables family `%s'.", fields[0]);
+      free(value_copy);
+      return 1;
+    }
+
+    fields++;
+    fields_num--;
+  }
+#endif
   if (fields_num < 2) {
     free(value_copy);
     return 1;
@@ -135,7 +210,7 @@ static int iptables_config(const char *key, const char *value) {
   chain = fields[1];
 
   size_t table_len = strlen(table) + 1;
-  if (table_len > sizeof(temp.table)) {
+  if (table_len > name_maxlen) {
     ERROR("Table `%s' too long.", table);
     free(value_copy);
     return 1;
@@ -143,7 +218,7 @@ static int iptables_config(const char *key, const char *value) {
   sstrncpy(temp.table, table, table_len);
 
   size_t chain_len = strlen(chain) + 1;
-  if (chain_len > sizeof(temp.chain)) {
+  if (chain_len > name_maxlen) {
     ERROR("Chain `%s' too long.", chain);
     free(value_copy);
     return 1;
@@ -346,60 +421,331 @@ static void submit_chain(iptc_handle_t *handle, ip_chain_t *chain) {
   } /* while (entry) */
 }
 
-static int iptables_read(void) {
-  int num_failures = 0;
-  ip_chain_t *chain;
+#if HAVE_LIBNFTNL
+#ifdef MNL_SOCKET_DUMP_SIZE
+#define NFT_BUFFER_SIZE MNL_SOCKET_DUMP_SIZE
+#else
+#define NFT_BUFFER_SIZE 32768
+#endif
 
-  /* Init the iptc handle structure and query the correct table */
-  for (int i = 0; i < chain_num; i++) {
-    chain = chain_list[i];
+typedef struct {
+  ip_chain_t **chains;
+  int chains_num;
+  int rule_num;
+} nft_dump_t;
 
-    if (!chain) {
-      DEBUG("iptables plugin: chain == NULL");
-      continue;
-    }
+typedef struct {
+  bool found;
+  uint64_t bytes;
+  uint64_t packets;
+} nft_counter_t;
+
+static void nft_submit(const ip_chain_t *chain, int rule_num,
+                       const char *comment, const nft_counter_t *counter) {
+  int status;
+  value_list_t vl = VALUE_LIST_INIT;
+
+  /* Select the rules to collect */
+  if (chain->rule_type == RTYPE_NUM) {
+    if (chain->rule.num != rule_num)
+      return;
+  } else {
+    if (comment == NULL)
+      return;
+    if ((chain->rule_type == RTYPE_COMMENT) &&
+        (strcmp(chain->rule.comment, comment) != 0))
+      return;
+  }
+
+  sstrncpy(vl.plugin, "nftables", sizeof(vl.plugin));
+
+  status = ssnprintf(vl.plugin_instance, sizeof(vl.plugin_instance),
+                     "%s-%s-%s", nft_family_name(chain->family), chain->table,
+                     chain->chain);
+  if ((status < 1) || ((unsigned int)status >= sizeof(vl.plugin_instance)))
+    return;
+
+  if (chain->name[0] != '\0') {
+    sstrncpy(vl.type_instance, chain->name, sizeof(vl.type_instance));
+  } else {
+    if (chain->rule_type == RTYPE_NUM)
+      ssnprintf(vl.type_instance, sizeof(vl.type_instance), "%i",
+                chain->rule.num);
+    else
+      sstrncpy(vl.type_instance, comment, sizeof(vl.type_instance));
+  }
+
+  sstrncpy(vl.type, "ipt_bytes", sizeof(vl.type));
+  vl.values = &(value_t){.derive = (derive_t)counter->bytes};
+  vl.values_len = 1;
+  plugin_dispatch_values(&vl);
+
+  sstrncpy(vl.type, "ipt_packets", sizeof(vl.type));
+  vl.values = &(value_t){.derive = (derive_t)counter->packets};
+  plugin_dispatch_values(&vl);
+} /* void nft_submit */
+
+static int nft_counter_cb(struct nftnl_expr *expr, void *data) {
+  nft_counter_t *counter = data;
+
+  const char *name = nftnl_expr_get_str(expr, NFTNL_EXPR_NAME);
+  if ((name == NULL) || (strcmp(name, "counter") != 0))
+    return 0;
+
+  counter->bytes = nftnl_expr_get_u64(expr, NFTNL_EXPR_CTR_BYTES);
+  counter->packets = nftnl_expr_get_u64(expr, NFTNL_EXPR_CTR_PACKETS);
+  counter->found = true;
+
+  /* Only the first counter of a rule is reported. */
+  return -1;
+} /* int nft_counter_cb */
+
+static int nft_comment_cb(const struct nftnl_udata *attr, void *data) {
+  const char **comment = data;
+
+  if (nftnl_udata_type(attr) != NFT_UDATA_RULE_COMMENT)
+    return 0;
+
+  const char *value = nftnl_udata_get(attr);
+  uint8_t len = nftnl_udata_len(attr);
+  if ((len == 0) || (value[len - 1] != '\0'))
+    return -1;
+
+  *comment = value;
+  return 0;
+} /* int nft_comment_cb */
 
-    if (chain->ip_version == IPV4) {
+static int nft_rule_cb(const struct nlmsghdr *nlh, void *data) {
+  nft_dump_t *dump = data;
+  const ip_chain_t *chain = dump->chains[0];
+
+  struct nftnl_rule *rule = nftnl_rule_alloc();
+  if (rule == NULL)
+    return MNL_CB_ERROR;
+
+  if (nftnl_rule_nlmsg_parse(nlh, rule) < 0) {
+    nftnl_rule_free(rule);
+    return MNL_CB_OK;
+  }
+
+  /* Kernels before 4.19 ignore the table and chain of a rule dump request
+   * and return the complete ruleset of the family. */
+  const char *table = nftnl_rule_get_str(rule, NFTNL_RULE_TABLE);
+  const char *chain_name = nftnl_rule_get_str(rule, NFTNL_RULE_CHAIN);
+  if ((table == NULL) || (chain_name == NULL) ||
+      (strcmp(table, chain->table) != 0) ||
+      (strcmp(chain_name, chain->chain) != 0)) {
+    nftnl_rule_free(rule);
+    return MNL_CB_OK;
+  }
+
+  dump->rule_num++;
+
+  nft_counter_t counter = {0};
+  nftnl_expr_foreach(rule, nft_counter_cb, &counter);
+  if (counter.found) {
+    const char *comment = NULL;
+    uint32_t udata_len = 0;
+    const void *udata =
+        nftnl_rule_get_data(rule, NFTNL_RULE_USERDATA, &udata_len);
+    if (udata != NULL)
+      nftnl_udata_parse(udata, udata_len, nft_comment_cb, &comment);
+
+    for (int i = 0; i < dump->chains_num; i++)
+      nft_submit(dump->chains[i], dump->rule_num, comment, &counter);
+  }
+
+  nftnl_rule_free(rule);
+  return MNL_CB_OK;
+} /* int nft_rule_cb */
+
+static void nft_close(void) {
+  if (nft_sock == NULL)
+    return;
+
+  mnl_socket_close(nft_sock);
+  nft_sock = NULL;
+} /* void nft_close */
+
+static int nft_open(void) {
+  if (nft_sock != NULL)
+    return 0;
+
+  nft_sock = mnl_socket_open(NETLINK_NETFILTER);
+  if (nft_sock == NULL) {
+    ERROR("iptables plugin: mnl_socket_open failed: %s", STRERRNO);
+    return -1;
+  }
+
+  if (mnl_socket_bind(nft_sock, 0, MNL_SOCKET_AUTOPID) < 0) {
+    ERROR("iptables plugin: mnl_socket_bind failed: %s", STRERRNO);
+    nft_close();
+    return -1;
+  }
+
+  nft_portid = mnl_socket_get_portid(nft_sock);
+  return 0;
+} /* int nft_open */
+
+/* Dumps the rules of one chain and submits them for all "chains", which must
+ * all refer to the same family, table and chain. */
+static int nft_read_chain(ip_chain_t **chains, int chains_num) {
+  static char buf[NFT_BUFFER_SIZE];
+  const ip_chain_t *chain = chains[0];
+
+  if (nft_open() != 0)
+    return -1;
+
+  uint32_t seq = ++nft_seq;
+  struct nlmsghdr *nlh = nftnl_nlmsg_build_hdr(buf, NFT_MSG_GETRULE,
+                                               chain->family, NLM_F_DUMP, seq);
+
+  struct nftnl_rule *rule = nftnl_rule_alloc();
+  if (rule == NULL) {
+    ERROR("iptables plugin: nftnl_rule_alloc failed.");
+    return -1;
+  }
+  nftnl_rule_set_str(rule, NFTNL_RULE_TABLE, chain->table);
+  nftnl_rule_set_str(rule, NFTNL_RULE_CHAIN, chain->chain);
+  nftnl_rule_nlmsg_build_payload(nlh, rule);
+  nftnl_rule_free(rule);
+
+  if (mnl_socket_sendto(nft_sock, nlh, nlh->nlmsg_len) < 0) {
+    ERROR("iptables plugin: mnl_socket_sendto failed: %s", STRERRNO);
+    nft_close();
+    return -1;
+  }
+
+  nft_dump_t dump = {
+      .chains = chains,
+      .chains_num = chains_num,
+  };
+
+  ssize_t status;
+  while ((status = mnl_socket_recvfrom(nft_sock, buf, sizeof(buf))) > 0) {
+    status = mnl_cb_run(buf, (size_t)status, seq, nft_portid, nft_rule_cb,
+                        &dump);
+    if (status <= MNL_CB_STOP)
+      break;
+  }
+
+  if (status < 0) {
+    ERROR("iptables plugin: Dumping nftables chain %s %s %s failed: %s",
+          nft_family_name(chain->family), chain->table, chain->chain,
+          STRERRNO);
+    /* The socket may still hold parts of the dump; start over next time. */
+    nft_close();
+    return -1;
+  }
+
+  return 0;
+} /* int nft_read_chain */
+#endif /* HAVE_LIBNFTNL */
+
+static int iptables_read_table4(ip_chain_t **chains, int chains_num) {
 #ifdef HAVE_IPTC_HANDLE_T
-      iptc_handle_t _handle;
-      iptc_handle_t *handle = &_handle;
+  iptc_handle_t _handle;
+  iptc_handle_t *handle = &_handle;
 
-      *handle = iptc_init(chain->table);
+  *handle = iptc_init(chains[0]->table);
 #else
-      iptc_handle_t *handle;
-      handle = iptc_init(chain->table);
+  iptc_handle_t *handle;
+  handle = iptc_init(chains[0]->table);
 #endif
 
-      if (!handle) {
-        ERROR("iptables plugin: iptc_init (%s) failed: %s", chain->table,
-              iptc_strerror(errno));
-        num_failures++;
-        continue;
-      }
+  if (!handle) {
+    ERROR("iptables plugin: iptc_init (%s) failed: %s", chains[0]->table,
+          iptc_strerror(errno));
+    return -1;
+  }
+
+  for (int i = 0; i < chains_num; i++)
+    submit_chain(handle, chains[i]);
+
+  iptc_free(handle);
+  return 0;
+} /* int iptables_read_table4 */
 
-      submit_chain(handle, chain);
-      iptc_free(handle);
-    } else if (chain->ip_version == IPV6) {
+static int iptables_read_table6(ip_chain_t **chains, int chains_num) {
 #ifdef HAVE_IP6TC_HANDLE_T
-      ip6tc_handle_t _handle;
-      ip6tc_handle_t *handle = &_handle;
+  ip6tc_handle_t _handle;
+  ip6tc_handle_t *handle = &_handle;
 
-      *handle = ip6tc_init(chain->table);
+  *handle = ip6tc_init(chains[0]->table);
 #else
-      ip6tc_handle_t *handle;
-      handle = ip6tc_init(chain->table);
+  ip6tc_handle_t *handle;
+  handle = ip6tc_init(chains[0]->table);
 #endif
-      if (!handle) {
-        ERROR("iptables plugin: ip6tc_init (%s) failed: %s", chain->table,
-              ip6tc_strerror(errno));
-        num_failures++;
-        continue;
-      }
 
-      submit6_chain(handle, chain);
-      ip6tc_free(handle);
-    } else
-      num_failures++;
+  if (!handle) {
+    ERROR("iptables plugin: ip6tc_init (%s) failed: %s", chains[0]->table,
+          ip6tc_strerror(errno));
+    return -1;
+  }
+
+  for (int i = 0; i < chains_num; i++)
+    submit6_chain(handle, chains[i]);
+
+  ip6tc_free(handle);
+  return 0;
+} /* int iptables_read_table6 */
+
+/* Orders the chain list so that entries sharing a snapshot (the table for
+ * iptables, the chain for nftables) are adjacent. */
+static int chain_compare(const void *a, const void *b) {
+  const ip_chain_t *c1 = *(const ip_chain_t *const *)a;
+  const ip_chain_t *c2 = *(const ip_chain_t *const *)b;
+
+  if (c1->ip_version != c2->ip_version)
+    return (c1->ip_version < c2->ip_version) ? -1 : 1;
+  if (c1->family != c2->family)
+    return (c1->family < c2->family) ? -1 : 1;
+
+  int status = strcmp(c1->table, c2->table);
+  if (status != 0)
+    return status;
+
+  return strcmp(c1->chain, c2->chain);
+} /* int chain_compare */
+
+static bool chain_same_snapshot(const ip_chain_t *c1, const ip_chain_t *c2) {
+  if ((c1->ip_version != c2->ip_version) || (c1->family != c2->family) ||
+      (strcmp(c1->table, c2->table) != 0))
+    return false;
+
+  /* nftables dumps are filtered by chain. */
+  if (c1->ip_version == NFT)
+    return strcmp(c1->chain, c2->chain) == 0;
+
+  return true;
+} /* bool chain_same_snapshot */
+
+static int iptables_read(void) {
+  int num_failures = 0;
+
+  /* Take one snapshot per table (per chain for nftables) and use it for all
+   * configured entries referring to it. The list has been sorted by
+   * iptables_init(), so those entries are adjacent. */
+  for (int i = 0; i < chain_num;) {
+    ip_chain_t **chains = chain_list + i;
+    int n = 1;
+
+    while ((i + n < chain_num) && chain_same_snapshot(chains[0], chains[n]))
+      n++;
+    i += n;
+
+    int status = -1;
+    if (chains[0]->ip_version == IPV4)
+      status = iptables_read_table4(chains, n);
+    else if (chains[0]->ip_version == IPV6)
+      status = iptables_read_table6(chains, n);
+#if HAVE_LIBNFTNL
+    else if (chains[0]->ip_version == NFT)
+      status = nft_read_chain(chains, n);
+#endif
+
+    if (status != 0)
+      num_failures += n;
   } /* for (i = 0 .. chain_num) */
 
   return (num_failures < chain_num) ? 0 : -1;
@@ -413,6 +759,10 @@ static int iptables_shutdown(void) {
   }
   sfree(chain_list);
 
+#if HAVE_LIBNFTNL
+  nft_close();
+#endif
+
   return 0;
 } /* int iptables_shutdown */
 
@@ -430,6 +780,10 @@ static int iptables_init(void) {
               "running \"setcap cap_net_admin=ep\" on the collectd binary.");
   }
 #endif
+
+  if (chain_num > 0)
+    qsort(chain_list, (size_t)chain_num, sizeof(*chain_list), chain_compare);
+
   return 0;
 } /* int iptables_init */
 
@@ -44,6 +44,12 @@
 
 #include <linux/ip_vs.h>
 
+#if HAVE_LIBMNL
+#include <libmnl/libmnl.h>
+#include <linux/genetlink.h>
+#include <linux/netfilter.h>
+#endif
+
 #define log_err(...) ERROR("ipvs: " __VA_ARGS__)
 #define log_info(...) INFO("ipvs: " __VA_ARGS__)
 
@@ -52,6 +58,14 @@
  */
 static int sockfd = -1;
 
+typedef struct {
+  derive_t conns;
+  derive_t inpkts;
+  derive_t outpkts;
+  derive_t inbytes;
+  derive_t outbytes;
+} cipvs_stats_t;
+
 /*
  * libipvs API
  */
@@ -117,53 +131,26 @@ static struct ip_vs_get_dests *ipvs_get_dests(struct ip_vs_service_entry *se) {
 /*
  * collectd plugin API and helper functions
  */
-static int cipvs_init(void) {
-  struct ip_vs_getinfo ipvs_info;
-
-  if ((sockfd = socket(AF_INET, SOCK_RAW, IPPROTO_RAW)) == -1) {
-    log_err("cipvs_init: socket() failed: %s", STRERRNO);
-    return -1;
-  }
-
-  socklen_t len = sizeof(ipvs_info);
-
-  if (getsockopt(sockfd, IPPROTO_IP, IP_VS_SO_GET_INFO, &ipvs_info, &len) ==
-      -1) {
-    log_err("cipvs_init: getsockopt() failed: %s", STRERRNO);
-    close(sockfd);
-    sockfd = -1;
-    return -1;
-  }
-
-  /* we need IPVS >= 1.1.4 */
-  if (ipvs_info.version < ((1 << 16) + (1 << 8) + 4)) {
-    log_err("cipvs_init: IPVS version too old (%d.%d.%d < %d.%d.%d)",
-            NVERSION(ipvs_info.version), 1, 1, 4);
-    close(sockfd);
-    sockfd = -1;
-    return -1;
-  } else {
-    log_info("Successfully connected to IPVS %d.%d.%d",
-             NVERSION(ipvs_info.version));
-  }
-  return 0;
-} /* cipvs_init */
 
 /*
  * ipvs-<virtual IP>_{UDP,TCP}<port>/<type>-total
  * ipvs-<virtual IP>_{UDP,TCP}<port>/<type>-<real IP>_<port>
  */
 
-/* plugin instance */
-static int get_pi(struct ip_vs_service_entry *se, char *pi, size_t size) {
-  if ((se == NULL) || (pi == NULL))
+/* plugin instance; addr and port are in network byte order */
+static int get_pi(int af, void const *addr, uint16_t protocol, uint16_t port,
+                  char *pi, size_t size) {
+  if ((addr == NULL) || (pi == NULL))
     return 0;
 
-  struct in_addr addr = {.s_addr = se->addr};
+  char addr_str[INET6_ADDRSTRLEN];
+  if (inet_ntop(af, addr, addr_str, sizeof(addr_str)) == NULL) {
+    log_err("inet_ntop failed: %s", STRERRNO);
+    return -1;
+  }
 
-  int len =
-      snprintf(pi, size, "%s_%s%u", inet_ntoa(addr),
-               (se->protocol == IPPROTO_TCP) ? "TCP" : "UDP", ntohs(se->port));
+  int len = snprintf(pi, size, "%s_%s%u", addr_str,
+                     (protocol == IPPROTO_TCP) ? "TCP" : "UDP", ntohs(port));
 
   if ((len < 0) || (size <= ((size_t)len))) {
     log_err("plugin instance truncated: %s", pi);
@@ -172,14 +159,19 @@ static int get_pi(struct ip_vs_service_entry *se, char *pi, size_t size) {
   return 0;
 } /* get_pi */
 
-/* type instance */
-static int get_ti(struct ip_vs_dest_entry *de, char *ti, size_t size) {
-  if ((de == NULL) || (ti == NULL))
+/* type instance; addr and port are in network byte order */
+static int get_ti(int af, void const *addr, uint16_t port, char *ti,
+                  size_t size) {
+  if ((addr == NULL) || (ti == NULL))
     return 0;
 
-  struct in_addr addr = {.s_addr = de->addr};
+  char addr_str[INET6_ADDRSTRLEN];
+  if (inet_ntop(af, addr, addr_str, sizeof(addr_str)) == NULL) {
+    log_err("inet_ntop failed: %s", STRERRNO);
+    return -1;
+  }
 
-  int len = snprintf(ti, size, "%s_%u", inet_ntoa(addr), ntohs(de->port));
+  int len = snprintf(ti, size, "%s_%u", addr_str, ntohs(port));
 
   if ((len < 0) || (size <= ((size_t)len))) {
     log_err("type instance truncated: %s", ti);
@@ -224,33 +216,45 @@ static void cipvs_submit_if(const char *pi, const char *t, const char *ti,
   plugin_dispatch_values(&vl);
 } /* cipvs_submit_if */
 
-static void cipvs_submit_dest(const char *pi, struct ip_vs_dest_entry *de) {
-  struct ip_vs_stats_user stats = de->stats;
+static void cipvs_submit_stats(const char *pi, const char *ti,
+                               cipvs_stats_t const *stats) {
+  cipvs_submit_connections(pi, ti, stats->conns);
+  cipvs_submit_if(pi, "if_packets", ti, stats->inpkts, stats->outpkts);
+  cipvs_submit_if(pi, "if_octets", ti, stats->inbytes, stats->outbytes);
+} /* cipvs_submit_stats */
+
+static cipvs_stats_t cipvs_stats_user(struct ip_vs_stats_user const *s) {
+  return (cipvs_stats_t){
+      .conns = s->conns,
+      .inpkts = s->inpkts,
+      .outpkts = s->outpkts,
+      .inbytes = s->inbytes,
+      .outbytes = s->outbytes,
+  };
+} /* cipvs_stats_user */
 
+static void cipvs_submit_dest(const char *pi, struct ip_vs_dest_entry *de) {
   char ti[DATA_MAX_NAME_LEN];
 
-  if (get_ti(de, ti, sizeof(ti)) != 0)
+  if (get_ti(AF_INET, &de->addr, de->port, ti, sizeof(ti)) != 0)
     return;
 
-  cipvs_submit_connections(pi, ti, stats.conns);
-  cipvs_submit_if(pi, "if_packets", ti, stats.inpkts, stats.outpkts);
-  cipvs_submit_if(pi, "if_octets", ti, stats.inbytes, stats.outbytes);
+  cipvs_stats_t stats = cipvs_stats_user(&de->stats);
+  cipvs_submit_stats(pi, ti, &stats);
 } /* cipvs_submit_dest */
 
 static void cipvs_submit_service(struct ip_vs_service_entry *se) {
-  struct ip_vs_stats_user stats = se->stats;
-  struct ip_vs_get_dests *dests = ipvs_get_dests(se);
-
   char pi[DATA_MAX_NAME_LEN];
 
-  if (get_pi(se, pi, sizeof(pi)) != 0) {
-    free(dests);
+  if (get_pi(AF_INET, &se->addr, se->protocol, se->port, pi, sizeof(pi)) != 0)
     return;
-  }
 
-  cipvs_submit_connections(pi, NULL, stats.conns);
-  cipvs_submit_if(pi, "if_packets", NULL, stats.inpkts, stats.outpkts);
-  cipvs_submit_if(pi, "if_octets", NULL, stats.inbytes, stats.outbytes);
+  cipvs_stats_t stats = cipvs_stats_user(&se->stats);
+  cipvs_submit_stats(pi, NULL, &stats);
+
+  struct ip_vs_get_dests *dests = ipvs_get_dests(se);
+  if (dests == NULL)
+    return;
 
   for (size_t i = 0; i < dests->num_dests; ++i)
     cipvs_submit_dest(pi, &dests->entrytable[i]);
@@ -259,10 +263,7 @@ static void cipvs_submit_service(struct ip_vs_service_entry *se) {
   return;
 } /* cipvs_submit_service */
 
-static int cipvs_read(void) {
-  if (sockfd < 0)
-    return -1;
-
+static int cipvs_sockopt_read(void) {
   struct ip_vs_get_services *services = ipvs_get_services();
   if (services == NULL)
     return -1;
@@ -272,9 +273,413 @@ static int cipvs_read(void) {
 
   free(services);
   return 0;
+} /* cipvs_sockopt_read */
+
+#if HAVE_LIBMNL
+/*
+ * Generic netlink backend: the service table is fetched with a single
+ * IPVS_CMD_GET_SERVICE dump and the real servers with one IPVS_CMD_GET_DEST
+ * dump per service, using the 64 bit counters where the kernel provides them.
+ */
+typedef struct {
+  uint16_t af;
+  uint16_t protocol;
+  union nf_inet_addr addr;
+  uint16_t port;
+  uint32_t fwmark;
+  cipvs_stats_t stats;
+  cipvs_stats_t stats64;
+  bool have_stats64;
+} cipvs_service_t;
+
+typedef struct {
+  uint16_t af;
+  union nf_inet_addr addr;
+  uint16_t port;
+  cipvs_stats_t stats;
+  cipvs_stats_t stats64;
+  bool have_stats64;
+} cipvs_dest_t;
+
+/* Recommended receive buffer size for netlink dumps, see
+ * MNL_SOCKET_DUMP_SIZE in newer versions of libmnl. */
+#define CIPVS_NL_BUFFER_SIZE 32768
+
+static struct mnl_socket *nl;
+static uint32_t nl_port_id;
+static uint32_t nl_seq;
+static uint16_t genl_id_ipvs;
+static char *nl_buffer;
+
+/* Services of the current read, kept across reads to avoid reallocating. */
+static cipvs_service_t *genl_services;
+static size_t genl_services_num;
+static size_t genl_services_size;
+
+static int stats_attr_cb(const struct nlattr *attr, void *data) {
+  cipvs_stats_t *stats = data;
+  bool is64 = (mnl_attr_get_payload_len(attr) == sizeof(uint64_t));
+
+  derive_t value = is64 ? (derive_t)mnl_attr_get_u64(attr)
+                        : (derive_t)mnl_attr_get_u32(attr);
+
+  switch (mnl_attr_get_type(attr)) {
+  case IPVS_STATS_ATTR_CONNS:
+    stats->conns = value;
+    break;
+  case IPVS_STATS_ATTR_INPKTS:
+    stats->inpkts = value;
+    break;
+  case IPVS_STATS_ATTR_OUTPKTS:
+    stats->outpkts = value;
+    break;
+  case IPVS_STATS_ATTR_INBYTES:
+    stats->inbytes = value;
+    break;
+  case IPVS_STATS_ATTR_OUTBYTES:
+    stats->outbytes = value;
+    break;
+  }
+  return MNL_CB_OK;
+} /* stats_attr_cb */
+
+static int parse_stats(const struct nlattr *attr, cipvs_stats_t *ret_stats) {
+  *ret_stats = (cipvs_stats_t){0};
+  return mnl_attr_parse_nested(attr, stats_attr_cb, ret_stats);
+} /* parse_stats */
+
+static int copy_addr(const struct nlattr *attr, union nf_inet_addr *ret_addr) {
+  size_t len = mnl_attr_get_payload_len(attr);
+  if (len > sizeof(*ret_addr))
+    len = sizeof(*ret_addr);
+
+  memcpy(ret_addr, mnl_attr_get_payload(attr), len);
+  return MNL_CB_OK;
+} /* copy_addr */
+
+static int service_attr_cb(const struct nlattr *attr, void *data) {
+  cipvs_service_t *svc = data;
+
+  switch (mnl_attr_get_type(attr)) {
+  case IPVS_SVC_ATTR_AF:
+    svc->af = mnl_attr_get_u16(attr);
+    break;
+  case IPVS_SVC_ATTR_PROTOCOL:
+    svc->protocol = mnl_attr_get_u16(attr);
+    break;
+  case IPVS_SVC_ATTR_ADDR:
+    return copy_addr(attr, &svc->addr);
+  case IPVS_SVC_ATTR_PORT:
+    svc->port = mnl_attr_get_u16(attr);
+    break;
+  case IPVS_SVC_ATTR_FWMARK:
+    svc->fwmark = mnl_attr_get_u32(attr);
+    break;
+  case IPVS_SVC_ATTR_STATS:
+    return parse_stats(attr, &svc->stats);
+  case IPVS_SVC_ATTR_STATS64:
+    svc->have_stats64 = true;
+    return parse_stats(attr, &svc->stats64);
+  }
+  return MNL_CB_OK;
+} /* service_attr_cb */
+
+static int dest_attr_cb(const struct nlattr *attr, void *data) {
+  cipvs_dest_t *dest = data;
+
+  switch (mnl_attr_get_type(attr)) {
+  case IPVS_DEST_ATTR_ADDR_FAMILY:
+    dest->af = mnl_attr_get_u16(attr);
+    break;
+  case IPVS_DEST_ATTR_ADDR:
+    return copy_addr(attr, &dest->addr);
+  case IPVS_DEST_ATTR_PORT:
+    dest->port = mnl_attr_get_u16(attr);
+    break;
+  case IPVS_DEST_ATTR_STATS:
+    return parse_stats(attr, &dest->stats);
+  case IPVS_DEST_ATTR_STATS64:
+    dest->have_stats64 = true;
+    return parse_stats(attr, &dest->stats64);
+  }
+  return MNL_CB_OK;
+} /* dest_attr_cb */
+
+/* cmd_attr_cb finds the nested IPVS_CMD_ATTR_SERVICE or IPVS_CMD_ATTR_DEST
+ * attribute of a reply and stores a pointer to it in data. */
+static int cmd_attr_cb(const struct nlattr *attr, void *data) {
+  const struct nlattr **tb = data;
+  uint16_t type = mnl_attr_get_type(attr);
+
+  if ((type == IPVS_CMD_ATTR_SERVICE) || (type == IPVS_CMD_ATTR_DEST))
+    tb[type] = attr;
+  return MNL_CB_OK;
+} /* cmd_attr_cb */
+
+static int service_msg_cb(const struct nlmsghdr *nlh,
+                          __attribute__((unused)) void *data) {
+  const struct nlattr *tb[IPVS_CMD_ATTR_MAX + 1] = {NULL};
+  if (mnl_attr_parse(nlh, sizeof(struct genlmsghdr), cmd_attr_cb, tb) < 0)
+    return MNL_CB_ERROR;
+  if (tb[IPVS_CMD_ATTR_SERVICE] == NULL)
+    return MNL_CB_OK;
+
+  cipvs_service_t svc = {.af = AF_INET};
+  if (mnl_attr_parse_nested(tb[IPVS_CMD_ATTR_SERVICE], service_attr_cb,
+                            &svc) < 0)
+    return MNL_CB_ERROR;
+
+  if (svc.have_stats64)
+    svc.stats = svc.stats64;
+
+  if (genl_services_num >= genl_services_size) {
+    size_t new_size = (genl_services_size == 0) ? 64 : 2 * genl_services_size;
+    cipvs_service_t *tmp =
+        realloc(genl_services, new_size * sizeof(*genl_services));
+    if (tmp == NULL) {
+      log_err("service_msg_cb: Out of memory.");
+      return MNL_CB_ERROR;
+    }
+    genl_services = tmp;
+    genl_services_size = new_size;
+  }
+  genl_services[genl_services_num++] = svc;
+  return MNL_CB_OK;
+} /* service_msg_cb */
+
+static int dest_msg_cb(const struct nlmsghdr *nlh, void *data) {
+  cipvs_service_t const *svc = data;
+
+  const struct nlattr *tb[IPVS_CMD_ATTR_MAX + 1] = {NULL};
+  if (mnl_attr_parse(nlh, sizeof(struct genlmsghdr), cmd_attr_cb, tb) < 0)
+    return MNL_CB_ERROR;
+  if (tb[IPVS_CMD_ATTR_DEST] == NULL)
+    return MNL_CB_OK;
+
+  cipvs_dest_t dest = {.af = svc->af};
+  if (mnl_attr_parse_nested(tb[IPVS_CMD_ATTR_DEST], dest_attr_cb, &dest) < 0)
+    return MNL_CB_ERROR;
+
+  char pi[DATA_MAX_NAME_LEN];
+  char ti[DATA_MAX_NAME_LEN];
+  if ((get_pi(svc->af, &svc->addr, svc->protocol, svc->port, pi,
+              sizeof(pi)) != 0) ||
+      (get_ti(dest.af, &dest.addr, dest.port, ti, sizeof(ti)) != 0))
+    return MNL_CB_OK;
+
+  cipvs_submit_stats(pi, ti, dest.have_stats64 ? &dest.stats64 : &dest.stats);
+  return MNL_CB_OK;
+} /* dest_msg_cb */
+
+static struct nlmsghdr *genl_put_header(uint16_t type, uint8_t cmd,
+                                        uint8_t version, uint16_t flags) {
+  struct nlmsghdr *nlh = mnl_nlmsg_put_header(nl_buffer);
+  *nlh = (struct nlmsghdr){
+      .nlmsg_len = nlh->nlmsg_len,
+      .nlmsg_type = type,
+      .nlmsg_flags = NLM_F_REQUEST | flags,
+      .nlmsg_seq = ++nl_seq,
+  };
+
+  struct genlmsghdr *genh = mnl_nlmsg_put_extra_header(nlh, sizeof(*genh));
+  *genh = (struct genlmsghdr){
+      .cmd = cmd,
+      .version = version,
+  };
+  return nlh;
+} /* genl_put_header */
+
+/* genl_talk sends the request in nlh and runs cb for every reply until the
+ * (multipart) answer is complete. */
+static int genl_talk(struct nlmsghdr *nlh, mnl_cb_t cb, void *data) {
+  uint32_t seq = nlh->nlmsg_seq;
+
+  if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0) {
+    log_err("mnl_socket_sendto() failed: %s", STRERRNO);
+    return -1;
+  }
+
+  while (42) {
+    ssize_t len = mnl_socket_recvfrom(nl, nl_buffer, CIPVS_NL_BUFFER_SIZE);
+    if (len < 0) {
+      log_err("mnl_socket_recvfrom() failed: %s", STRERRNO);
+      return -1;
+    }
+
+    int status = mnl_cb_run(nl_buffer, (size_t)len, seq, nl_port_id, cb, data);
+    if (status < MNL_CB_STOP) {
+      log_err("netlink request failed: %s", STRERRNO);
+      return -1;
+    } else if (status == MNL_CB_STOP) {
+      return 0;
+    }
+  }
+} /* genl_talk */
+
+static int family_id_attr_cb(const struct nlattr *attr, void *data) {
+  if (mnl_attr_get_type(attr) != CTRL_ATTR_FAMILY_ID)
+    return MNL_CB_OK;
+
+  if (mnl_attr_validate(attr, MNL_TYPE_U16) < 0)
+    return MNL_CB_ERROR;
+
+  /* The reply is not multipart, so end genl_talk() here. */
+  *(uint16_t *)data = mnl_attr_get_u16(attr);
+  return MNL_CB_STOP;
+} /* family_id_attr_cb */
+
+static int family_id_msg_cb(const struct nlmsghdr *nlh, void *data) {
+  return mnl_attr_parse(nlh, sizeof(struct genlmsghdr), family_id_attr_cb,
+                        data);
+} /* family_id_msg_cb */
+
+static void cipvs_genl_close(void) {
+  if (nl != NULL)
+    mnl_socket_close(nl);
+  nl = NULL;
+  genl_id_ipvs = 0;
+
+  sfree(nl_buffer);
+  sfree(genl_services);
+  genl_services_num = 0;
+  genl_services_size = 0;
+} /* cipvs_genl_close */
+
+static int cipvs_genl_open(void) {
+  nl_buffer = malloc(CIPVS_NL_BUFFER_SIZE);
+  if (nl_buffer == NULL) {
+    log_err("cipvs_genl_open: Out of memory.");
+    return -1;
+  }
+
+  if ((nl = mnl_socket_open(NETLINK_GENERIC)) == NULL) {
+    log_err("mnl_socket_open(NETLINK_GENERIC) failed: %s", STRERRNO);
+    cipvs_genl_close();
+    return -1;
+  }
+
+  if (mnl_socket_bind(nl, 0, MNL_SOCKET_AUTOPID) != 0) {
+    log_err("mnl_socket_bind() failed: %s", STRERRNO);
+    cipvs_genl_close();
+    return -1;
+  }
+  nl_port_id = mnl_socket_get_portid(nl);
+
+  struct nlmsghdr *nlh =
+      genl_put_header(GENL_ID_CTRL, CTRL_CMD_GETFAMILY, 0x01, 0);
+  mnl_attr_put_strz(nlh, CTRL_ATTR_FAMILY_NAME, IPVS_GENL_NAME);
+
+  if ((genl_talk(nlh, family_id_msg_cb, &genl_id_ipvs) != 0) ||
+      (genl_id_ipvs == 0)) {
+    log_info("Generic netlink family \"" IPVS_GENL_NAME "\" not available");
+    cipvs_genl_close();
+    return -1;
+  }
+
+  return 0;
+} /* cipvs_genl_open */
+
+static int cipvs_genl_read_dests(cipvs_service_t const *svc) {
+  struct nlmsghdr *nlh = genl_put_header(genl_id_ipvs, IPVS_CMD_GET_DEST,
+                                         IPVS_GENL_VERSION, NLM_F_DUMP);
+
+  struct nlattr *nest = mnl_attr_nest_start(nlh, IPVS_CMD_ATTR_SERVICE);
+  mnl_attr_put_u16(nlh, IPVS_SVC_ATTR_AF, svc->af);
+  if (svc->fwmark != 0) {
+    mnl_attr_put_u32(nlh, IPVS_SVC_ATTR_FWMARK, svc->fwmark);
+  } else {
+    mnl_attr_put_u16(nlh, IPVS_SVC_ATTR_PROTOCOL, svc->protocol);
+    mnl_attr_put(nlh, IPVS_SVC_ATTR_ADDR, sizeof(svc->addr), &svc->addr);
+    mnl_attr_put_u16(nlh, IPVS_SVC_ATTR_PORT, svc->port);
+  }
+  mnl_attr_nest_end(nlh, nest);
+
+  return genl_talk(nlh, dest_msg_cb, (void *)svc);
+} /* cipvs_genl_read_dests */
+
+static int cipvs_genl_read(void) {
+  genl_services_num = 0;
+
+  struct nlmsghdr *nlh = genl_put_header(genl_id_ipvs, IPVS_CMD_GET_SERVICE,
+                                         IPVS_GENL_VERSION, NLM_F_DUMP);
+  if (genl_talk(nlh, service_msg_cb, NULL) != 0)
+    return -1;
+
+  for (size_t i = 0; i < genl_services_num; i++) {
+    cipvs_service_t const *svc = genl_services + i;
+    char pi[DATA_MAX_NAME_LEN];
+
+    if (get_pi(svc->af, &svc->addr, svc->protocol, svc->port, pi,
+               sizeof(pi)) != 0)
+      continue;
+
+    cipvs_submit_stats(pi, NULL, &svc->stats);
+
+    /* A service may disappear between the two dumps. */
+    if (cipvs_genl_read_dests(svc) != 0)
+      log_info("Reading real servers of %s failed", pi);
+  }
+
+  return 0;
+} /* cipvs_genl_read */
+#endif /* HAVE_LIBMNL */
+
+static int cipvs_init(void) {
+  struct ip_vs_getinfo ipvs_info;
+
+#if HAVE_LIBMNL
+  if (cipvs_genl_open() == 0) {
+    log_info("Using the generic netlink interface");
+    return 0;
+  }
+#endif
+
+  if ((sockfd = socket(AF_INET, SOCK_RAW, IPPROTO_RAW)) == -1) {
+    log_err("cipvs_init: socket() failed: %s", STRERRNO);
+    return -1;
+  }
+
+  socklen_t len = sizeof(ipvs_info);
+
+  if (getsockopt(sockfd, IPPROTO_IP, IP_VS_SO_GET_INFO, &ipvs_info, &len) ==
+      -1) {
+    log_err("cipvs_init: getsockopt() failed: %s", STRERRNO);
+    close(sockfd);
+    sockfd = -1;
+    return -1;
+  }
+
+  /* we need IPVS >= 1.1.4 */
+  if (ipvs_info.version < ((1 << 16) + (1 << 8) + 4)) {
+    log_err("cipvs_init: IPVS version too old (%d.%d.%d < %d.%d.%d)",
+            NVERSION(ipvs_info.version), 1, 1, 4);
+    close(sockfd);
+    sockfd = -1;
+    return -1;
+  } else {
+    log_info("Successfully connected to IPVS %d.%d.%d",
+             NVERSION(ipvs_info.version));
+  }
+  return 0;
+} /* cipvs_init */
+
+static int cipvs_read(void) {
+#if HAVE_LIBMNL
+  if (nl != NULL)
+    return cipvs_genl_read();
+#endif
+
+  if (sockfd < 0)
+    return -1;
+
+  return cipvs_sockopt_read();
 } /* cipvs_read */
 
 static int cipvs_shutdown(void) {
+#if HAVE_LIBMNL
+  cipvs_genl_close();
+#endif
+
   if (sockfd >= 0)
     close(sockfd);
   sockfd = -1;
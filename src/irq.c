@@ -26,6 +26,7 @@
 #include "plugin.h"
 #include "utils/common/common.h"
 #include "utils/ignorelist/ignorelist.h"
+#include "utils/procfs/procfs.h"
 
 #if !KERNEL_LINUX && !KERNEL_NETBSD
 #error "No applicable input method."
@@ -47,6 +48,17 @@ static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static ignorelist_t *ignorelist;
 
+#if KERNEL_LINUX
+static cu_procfs_t *proc_interrupts;
+
+/* The counters of one read, dispatched as one group. The names point into
+ * the buffer of proc_interrupts. */
+static char const **irq_names;
+static value_t *irq_values;
+static size_t irq_values_num;
+static size_t irq_values_size;
+#endif
+
 /*
  * Private functions
  */
@@ -84,11 +96,45 @@ static void irq_submit(const char *irq_name, derive_t value) {
 } /* void irq_submit */
 
 #if KERNEL_LINUX
+static void irq_batch_add(const char *irq_name, derive_t value) {
+  if (ignorelist_match(ignorelist, irq_name) != 0)
+    return;
+
+  if (irq_values_num == irq_values_size) {
+    size_t new_size = (irq_values_size == 0) ? 64 : 2 * irq_values_size;
+    char const **names = realloc(irq_names, new_size * sizeof(*irq_names));
+    if (names != NULL)
+      irq_names = names;
+    value_t *values = realloc(irq_values, new_size * sizeof(*irq_values));
+    if (values != NULL)
+      irq_values = values;
+
+    if ((names == NULL) || (values == NULL)) {
+      irq_submit(irq_name, value);
+      return;
+    }
+    irq_values_size = new_size;
+  }
+
+  irq_names[irq_values_num] = irq_name;
+  irq_values[irq_values_num].derive = value;
+  irq_values_num++;
+} /* void irq_batch_add */
+
+static void irq_batch_flush(void) {
+  value_list_t vl = VALUE_LIST_INIT;
+
+  vl.values_len = 1;
+  sstrncpy(vl.plugin, "irq", sizeof(vl.plugin));
+  sstrncpy(vl.type, "irq", sizeof(vl.type));
+
+  plugin_dispatch_values_bulk(&vl, irq_names, irq_values, irq_values_num);
+  irq_values_num = 0;
+} /* void irq_batch_flush */
+
 static int irq_read(void) {
-  FILE *fh;
-  char buffer[1024];
+  char *buffer;
   int cpu_count;
-  char *fields[256];
 
   /*
    * Example content:
@@ -96,46 +142,42 @@ static int irq_read(void) {
    * 0:       2574          1          3          2   IO-APIC-edge      timer
    * 1:     102553     158669     218062      70587   IO-APIC-edge      i8042
    * 8:          0          0          0          1   IO-APIC-edge      rtc0
+   *
+   * On large machines the lines have hundreds of columns, so they are not
+   * split into fields: the counters are summed up while parsing them.
    */
-  fh = fopen("/proc/interrupts", "r");
-  if (fh == NULL) {
-    ERROR("irq plugin: fopen (/proc/interrupts): %s", STRERRNO);
+  if ((proc_interrupts == NULL) &&
+      ((proc_interrupts = cu_procfs_open("/proc/interrupts")) == NULL)) {
+    ERROR("irq plugin: open (/proc/interrupts): %s", STRERRNO);
+    return -1;
+  }
+
+  char *cursor = cu_procfs_read(proc_interrupts, NULL);
+  if (cursor == NULL) {
+    ERROR("irq plugin: reading /proc/interrupts failed: %s", STRERRNO);
     return -1;
   }
 
   /* Get CPU count from the first line */
-  if (fgets(buffer, sizeof(buffer), fh) != NULL) {
-    cpu_count = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
-  } else {
+  if ((buffer = cu_procfs_line(&cursor)) == NULL) {
     ERROR("irq plugin: unable to get CPU count from first line "
           "of /proc/interrupts");
-    fclose(fh);
     return -1;
   }
+  cpu_count = 0;
+  for (char *ptr = buffer + strspn(buffer, " \t"); *ptr != 0;
+       ptr += strspn(ptr, " \t")) {
+    ptr += strcspn(ptr, " \t");
+    cpu_count++;
+  }
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
-    char *irq_name;
-    size_t irq_name_len;
-    derive_t irq_value;
-    int i;
-    int fields_num;
-    int irq_values_to_parse;
-
-    fields_num = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
-    if (fields_num < 2)
-      continue;
-
-    /* Parse this many numeric fields, skip the rest
-     * (+1 because first there is a name of irq in each line) */
-    if (fields_num >= cpu_count + 1)
-      irq_values_to_parse = cpu_count;
-    else
-      irq_values_to_parse = fields_num - 1;
-
+  while ((buffer = cu_procfs_line(&cursor)) != NULL) {
     /* First field is irq name and colon */
-    irq_name = fields[0];
-    irq_name_len = strlen(irq_name);
-    if (irq_name_len < 2)
+    char *irq_name = buffer + strspn(buffer, " \t");
+    size_t irq_name_len = strcspn(irq_name, " \t");
+    char *ptr = irq_name + irq_name_len;
+
+    if ((irq_name_len < 2) || (*ptr == 0))
       continue;
 
     /* Check if irq name ends with colon.
@@ -150,30 +192,39 @@ static int irq_read(void) {
     irq_name[irq_name_len - 1] = '\0';
     irq_name_len--;
 
-    irq_value = 0;
-    for (i = 1; i <= irq_values_to_parse; i++) {
-      /* Per-CPU value */
-      value_t v;
-      int status;
-
-      status = parse_value(fields[i], &v, DS_TYPE_DERIVE);
-      if (status != 0)
+    /* Parse at most one per-CPU value per CPU, skip the rest (e.g. the
+     * description). */
+    uint64_t irq_value = 0;
+    int i;
+    for (i = 0; i < cpu_count; i++) {
+      uint64_t v;
+      char *end = cu_procfs_scan_u64(ptr, &v);
+      if ((end == NULL) || ((*end != ' ') && (*end != '\t') && (*end != 0)))
         break;
 
-      irq_value += v.derive;
+      irq_value += v;
+      ptr = end;
     } /* for (i) */
 
     /* No valid fields -> do not submit anything. */
-    if (i <= 1)
+    if (i == 0)
       continue;
 
-    irq_submit(irq_name, irq_value);
+    irq_batch_add(irq_name, (derive_t)irq_value);
   }
 
-  fclose(fh);
-
+  irq_batch_flush();
   return 0;
 } /* int irq_read */
+
+static int irq_shutdown(void) {
+  cu_procfs_close(proc_interrupts);
+  proc_interrupts = NULL;
+  sfree(irq_names);
+  sfree(irq_values);
+  irq_values_size = 0;
+  return 0;
+} /* int irq_shutdown */
 #endif /* KERNEL_LINUX */
 
 #if KERNEL_NETBSD
@@ -227,4 +278,7 @@ static int irq_read(void) {
 void module_register(void) {
   plugin_register_config("irq", irq_config, config_keys, config_keys_num);
   plugin_register_read("irq", irq_read);
+#if KERNEL_LINUX
+  plugin_register_shutdown("irq", irq_shutdown);
+#endif
 } /* void module_register */
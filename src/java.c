@@ -26,6 +26,7 @@
 #include "filter_chain.h"
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils_complain.h"
 
 #include <jni.h>
 
@@ -63,6 +64,7 @@ typedef struct java_plugin_class_s java_plugin_class_t;
 #define CB_TYPE_NOTIFICATION 8
 #define CB_TYPE_MATCH 9
 #define CB_TYPE_TARGET 10
+#define CB_TYPE_WRITE_BATCH 11
 struct cjni_callback_info_s /* {{{ */
 {
   char *name;
@@ -74,6 +76,52 @@ struct cjni_callback_info_s /* {{{ */
 typedef struct cjni_callback_info_s cjni_callback_info_t;
 /* }}} */
 
+/* Value lists encoded by cjni_batch_append(), see ValueListBatch.java. */
+struct cjni_batch_buffer_s /* {{{ */
+{
+  char *data;
+  size_t size;
+  size_t len;
+  size_t count;
+
+  /* Direct ByteBuffer wrapping "data", only used by the writer's thread. It
+   * stays with the buffer when "pending" and "sending" are swapped. */
+  jobject o_buffer;
+  char *o_buffer_data;
+  size_t o_buffer_size;
+};
+typedef struct cjni_batch_buffer_s cjni_batch_buffer_t;
+/* }}} */
+
+/* Writers registered with Collectd.registerWriteBatch. The write callback
+ * appends each value list to "pending". The writer's thread swaps "pending"
+ * and "sending" and passes the latter to Java as one direct ByteBuffer, so a
+ * batch costs one JNI call and no Java objects beyond what the Java side
+ * decodes. */
+struct cjni_batch_writer_s /* {{{ */
+{
+  cjni_callback_info_t *cbi;
+  pthread_t thread;
+  bool thread_running;
+  bool free_on_exit;
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  cjni_batch_buffer_t pending;
+  size_t queue_limit;
+  bool shutdown;
+
+  /* only accessed by the writer's thread */
+  cjni_batch_buffer_t sending;
+
+  uint64_t dropped;
+  c_complain_t complaint;
+
+  struct cjni_batch_writer_s *next;
+};
+typedef struct cjni_batch_writer_s cjni_batch_writer_t;
+/* }}} */
+
 /*
  * Global variables
  */
@@ -95,6 +143,10 @@ static pthread_mutex_t java_callbacks_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static oconfig_item_t *config_block;
 
+/* All batch writers, so they can be drained before the JVM is destroyed. */
+static cjni_batch_writer_t *batch_writers;
+static pthread_mutex_t batch_writers_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /*
  * Prototypes
  *
@@ -111,6 +163,10 @@ static int cjni_callback_register(JNIEnv *jvm_env, jobject o_name,
 static int cjni_read(user_data_t *user_data);
 static int cjni_write(const data_set_t *ds, const value_list_t *vl,
                       user_data_t *ud);
+static int cjni_write_batch(const data_set_t *ds, const value_list_t *vl,
+                            user_data_t *ud);
+static void *cjni_write_batch_thread(void *arg);
+static void cjni_batch_writer_destroy(void *arg);
 static int cjni_flush(cdtime_t timeout, const char *identifier,
                       user_data_t *ud);
 static void cjni_log(int severity, const char *message, user_data_t *ud);
@@ -1337,6 +1393,64 @@ static jint JNICALL cjni_api_register_write(JNIEnv *jvm_env, /* {{{ */
   return 0;
 } /* }}} jint cjni_api_register_write */
 
+static jint JNICALL cjni_api_register_write_batch(JNIEnv *jvm_env, /* {{{ */
+                                                  jobject this, jobject o_name,
+                                                  jobject o_write,
+                                                  jint queue_limit) {
+  cjni_batch_writer_t *w;
+  int status;
+
+  if (queue_limit < 1) {
+    ERROR("java plugin: registerWriteBatch: queueLimit must be positive.");
+    return -1;
+  }
+
+  w = calloc(1, sizeof(*w));
+  if (w == NULL) {
+    ERROR("java plugin: cjni_api_register_write_batch: calloc failed.");
+    return -1;
+  }
+
+  w->cbi =
+      cjni_callback_info_create(jvm_env, o_name, o_write, CB_TYPE_WRITE_BATCH);
+  if (w->cbi == NULL) {
+    sfree(w);
+    return -1;
+  }
+
+  w->queue_limit = (size_t)queue_limit;
+  C_COMPLAIN_INIT(&w->complaint);
+  pthread_mutex_init(&w->lock, NULL);
+  pthread_cond_init(&w->cond, NULL);
+
+  DEBUG("java plugin: Registering new batch write callback: %s", w->cbi->name);
+
+  status = plugin_thread_create(&w->thread, cjni_write_batch_thread, w,
+                                "java writer");
+  if (status != 0) {
+    ERROR("java plugin: Starting the thread of batch writer `%s' failed: %s",
+          w->cbi->name, STRERROR(status));
+    cjni_batch_writer_destroy(w);
+    return -1;
+  }
+  w->thread_running = true;
+
+  pthread_mutex_lock(&batch_writers_lock);
+  w->next = batch_writers;
+  batch_writers = w;
+  pthread_mutex_unlock(&batch_writers_lock);
+
+  plugin_register_write(w->cbi->name, cjni_write_batch,
+                        &(user_data_t){
+                            .data = w,
+                            .free_func = cjni_batch_writer_destroy,
+                        });
+
+  (*jvm_env)->DeleteLocalRef(jvm_env, o_write);
+
+  return 0;
+} /* }}} jint cjni_api_register_write_batch */
+
 static jint JNICALL cjni_api_register_flush(JNIEnv *jvm_env, /* {{{ */
                                             jobject this, jobject o_name,
                                             jobject o_flush) {
@@ -1533,6 +1647,11 @@ static JNINativeMethod jni_api_functions[] = /* {{{ */
          "(Ljava/lang/String;Lorg/collectd/api/CollectdWriteInterface;)I",
          cjni_api_register_write},
 
+        {"registerWriteBatch",
+         "(Ljava/lang/String;Lorg/collectd/api/"
+         "CollectdBatchWriteInterface;I)I",
+         cjni_api_register_write_batch},
+
         {"registerFlush",
          "(Ljava/lang/String;Lorg/collectd/api/CollectdFlushInterface;)I",
          cjni_api_register_flush},
@@ -1603,6 +1722,11 @@ cjni_callback_info_create(JNIEnv *jvm_env, /* {{{ */
     method_signature = "(Lorg/collectd/api/ValueList;)I";
     break;
 
+  case CB_TYPE_WRITE_BATCH:
+    method_name = "writeBatch";
+    method_signature = "(Ljava/nio/ByteBuffer;I)I";
+    break;
+
   case CB_TYPE_FLUSH:
     method_name = "flush";
     method_signature = "(Ljava/lang/Number;Ljava/lang/String;)I";
@@ -2353,6 +2477,265 @@ static int cjni_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
   return ret_status;
 } /* }}} int cjni_write */
 
+/* Appends "vl" to "b" in the layout documented in ValueListBatch.java:
+ *
+ *   uint32  size of the record in bytes
+ *   uint16  number of values (n)
+ *   uint16  reserved
+ *   int64   time, in milliseconds
+ *   int64   interval, in milliseconds
+ *   n * 8   values; double for gauges, int64 otherwise
+ *   n * 1   data source types (DS_TYPE_*)
+ *   5 times uint16 length and bytes of host, plugin, plugin instance, type
+ *           and type instance
+ *
+ * All integers are in host byte order. */
+static int cjni_batch_append(cjni_batch_buffer_t *b, /* {{{ */
+                             const data_set_t *ds, const value_list_t *vl) {
+  const char *strings[] = {vl->host, vl->plugin, vl->plugin_instance, vl->type,
+                           vl->type_instance};
+  uint16_t strings_len[STATIC_ARRAY_SIZE(strings)];
+  size_t size = 24 + 9 * vl->values_len;
+
+  if (vl->values_len > UINT16_MAX)
+    return EINVAL;
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(strings); i++) {
+    strings_len[i] = (uint16_t)strnlen(strings[i], DATA_MAX_NAME_LEN);
+    size += 2 + strings_len[i];
+  }
+
+  if (b->len + size > b->size) {
+    size_t new_size = (b->size == 0) ? 4096 : b->size;
+    while (b->len + size > new_size)
+      new_size *= 2;
+    char *tmp = realloc(b->data, new_size);
+    if (tmp == NULL)
+      return ENOMEM;
+    b->data = tmp;
+    b->size = new_size;
+  }
+
+  char *p = b->data + b->len;
+  uint32_t record_size = (uint32_t)size;
+  uint16_t values_len = (uint16_t)vl->values_len;
+  uint16_t reserved = 0;
+  int64_t time_ms = (int64_t)CDTIME_T_TO_MS(vl->time);
+  int64_t interval_ms = (int64_t)CDTIME_T_TO_MS(vl->interval);
+
+#define BATCH_PUT(v)                                                           \
+  do {                                                                         \
+    memcpy(p, &(v), sizeof(v));                                                \
+    p += sizeof(v);                                                            \
+  } while (0)
+  BATCH_PUT(record_size);
+  BATCH_PUT(values_len);
+  BATCH_PUT(reserved);
+  BATCH_PUT(time_ms);
+  BATCH_PUT(interval_ms);
+  for (size_t i = 0; i < vl->values_len; i++) {
+    if (ds->ds[i].type == DS_TYPE_GAUGE) {
+      double d = (double)vl->values[i].gauge;
+      BATCH_PUT(d);
+    } else if (ds->ds[i].type == DS_TYPE_DERIVE) {
+      int64_t v = (int64_t)vl->values[i].derive;
+      BATCH_PUT(v);
+    } else if (ds->ds[i].type == DS_TYPE_COUNTER) {
+      int64_t v = (int64_t)vl->values[i].counter;
+      BATCH_PUT(v);
+    } else {
+      int64_t v = (int64_t)vl->values[i].absolute;
+      BATCH_PUT(v);
+    }
+  }
+  for (size_t i = 0; i < vl->values_len; i++)
+    *p++ = (char)ds->ds[i].type;
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(strings); i++) {
+    BATCH_PUT(strings_len[i]);
+    memcpy(p, strings[i], strings_len[i]);
+    p += strings_len[i];
+  }
+#undef BATCH_PUT
+
+  b->len += size;
+  b->count++;
+  return 0;
+} /* }}} int cjni_batch_append */
+
+static int cjni_write_batch(const data_set_t *ds, /* {{{ */
+                            const value_list_t *vl, user_data_t *ud) {
+  cjni_batch_writer_t *w = ud->data;
+  int status;
+
+  pthread_mutex_lock(&w->lock);
+  if (w->pending.count >= w->queue_limit) {
+    w->dropped++;
+    pthread_mutex_unlock(&w->lock);
+    c_complain(LOG_WARNING, &w->complaint,
+               "java plugin: The queue of batch writer `%s' is full, "
+               "dropping values.",
+               w->cbi->name);
+    return ENOBUFS;
+  }
+  status = cjni_batch_append(&w->pending, ds, vl);
+  if (status == 0)
+    pthread_cond_signal(&w->cond);
+  pthread_mutex_unlock(&w->lock);
+
+  if (status != 0) {
+    ERROR("java plugin: cjni_write_batch: Encoding the value list failed: %s",
+          STRERROR(status));
+    return status;
+  }
+
+  c_release(LOG_INFO, &w->complaint,
+            "java plugin: The queue of batch writer `%s' accepts values "
+            "again.",
+            w->cbi->name);
+  return 0;
+} /* }}} int cjni_write_batch */
+
+/* Passes the "sending" buffer to the Java object. Must be called by the
+ * writer's thread. */
+static void cjni_write_batch_deliver(JNIEnv *jvm_env, /* {{{ */
+                                     cjni_batch_writer_t *w) {
+  cjni_batch_buffer_t *b = &w->sending;
+  jint status;
+
+  /* The buffer object is only re-created when the memory it wraps changed. */
+  if ((b->o_buffer == NULL) || (b->o_buffer_data != b->data) ||
+      (b->o_buffer_size != b->size)) {
+    if (b->o_buffer != NULL)
+      (*jvm_env)->DeleteGlobalRef(jvm_env, b->o_buffer);
+    b->o_buffer = NULL;
+
+    jobject o_local =
+        (*jvm_env)->NewDirectByteBuffer(jvm_env, b->data, (jlong)b->size);
+    if (o_local == NULL) {
+      ERROR("java plugin: cjni_write_batch_deliver: NewDirectByteBuffer "
+            "failed.");
+      return;
+    }
+    b->o_buffer = (*jvm_env)->NewGlobalRef(jvm_env, o_local);
+    (*jvm_env)->DeleteLocalRef(jvm_env, o_local);
+    if (b->o_buffer == NULL) {
+      ERROR("java plugin: cjni_write_batch_deliver: NewGlobalRef failed.");
+      return;
+    }
+    b->o_buffer_data = b->data;
+    b->o_buffer_size = b->size;
+  }
+
+  status = (*jvm_env)->CallIntMethod(jvm_env, w->cbi->object, w->cbi->method,
+                                     b->o_buffer, (jint)b->count);
+  if ((*jvm_env)->ExceptionCheck(jvm_env)) {
+    ERROR("java plugin: Batch writer `%s' threw an exception.", w->cbi->name);
+    (*jvm_env)->ExceptionDescribe(jvm_env);
+    (*jvm_env)->ExceptionClear(jvm_env);
+  } else if (status != 0) {
+    ERROR("java plugin: Batch writer `%s' failed with status %i.",
+          w->cbi->name, (int)status);
+  }
+} /* }}} void cjni_write_batch_deliver */
+
+static void cjni_batch_writer_free(cjni_batch_writer_t *w) /* {{{ */
+{
+  pthread_mutex_lock(&batch_writers_lock);
+  for (cjni_batch_writer_t **p = &batch_writers; *p != NULL; p = &(*p)->next) {
+    if (*p == w) {
+      *p = w->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&batch_writers_lock);
+
+  if (w->dropped > 0)
+    WARNING("java plugin: Batch writer `%s' dropped %" PRIu64 " value lists "
+            "because its queue was full.",
+            w->cbi->name, w->dropped);
+
+  sfree(w->pending.data);
+  sfree(w->sending.data);
+  pthread_mutex_destroy(&w->lock);
+  pthread_cond_destroy(&w->cond);
+  cjni_callback_info_destroy(w->cbi);
+  sfree(w);
+} /* }}} void cjni_batch_writer_free */
+
+static void *cjni_write_batch_thread(void *arg) /* {{{ */
+{
+  cjni_batch_writer_t *w = arg;
+  JNIEnv *jvm_env;
+  bool free_on_exit;
+
+  /* Stay attached for the lifetime of the thread. */
+  jvm_env = cjni_thread_attach();
+  if (jvm_env == NULL) {
+    ERROR("java plugin: Batch writer `%s': cjni_thread_attach failed.",
+          w->cbi->name);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&w->lock);
+  while (true) {
+    while (!w->shutdown && (w->pending.count == 0))
+      pthread_cond_wait(&w->cond, &w->lock);
+    if (w->pending.count == 0)
+      break;
+
+    cjni_batch_buffer_t tmp = w->pending;
+    w->pending = w->sending;
+    w->sending = tmp;
+    pthread_mutex_unlock(&w->lock);
+
+    cjni_write_batch_deliver(jvm_env, w);
+    w->sending.len = 0;
+    w->sending.count = 0;
+
+    pthread_mutex_lock(&w->lock);
+  }
+  free_on_exit = w->free_on_exit;
+  pthread_mutex_unlock(&w->lock);
+
+  cjni_batch_buffer_t *buffers[] = {&w->pending, &w->sending};
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(buffers); i++) {
+    if (buffers[i]->o_buffer != NULL)
+      (*jvm_env)->DeleteGlobalRef(jvm_env, buffers[i]->o_buffer);
+    buffers[i]->o_buffer = NULL;
+  }
+  cjni_thread_detach();
+
+  if (free_on_exit)
+    cjni_batch_writer_free(w);
+  return NULL;
+} /* }}} void *cjni_write_batch_thread */
+
+static void cjni_batch_writer_destroy(void *arg) /* {{{ */
+{
+  cjni_batch_writer_t *w = arg;
+
+  if (w == NULL)
+    return;
+
+  pthread_mutex_lock(&w->lock);
+  w->shutdown = true;
+  pthread_cond_signal(&w->cond);
+  if (w->thread_running && pthread_equal(pthread_self(), w->thread)) {
+    /* The Java write() method unregistered its own writer. The thread frees
+     * "w" after it detached from the JVM. */
+    w->free_on_exit = true;
+    pthread_mutex_unlock(&w->lock);
+    pthread_detach(w->thread);
+    return;
+  }
+  pthread_mutex_unlock(&w->lock);
+
+  if (w->thread_running)
+    pthread_join(w->thread, NULL);
+
+  cjni_batch_writer_free(w);
+} /* }}} void cjni_batch_writer_destroy */
+
 /* Call the CB_TYPE_FLUSH callback pointed to by the `user_data_t' pointer. */
 static int cjni_flush(cdtime_t timeout, const char *identifier, /* {{{ */
                       user_data_t *ud) {
@@ -2766,6 +3149,24 @@ static int cjni_shutdown(void) /* {{{ */
     return -1;
   }
 
+  /* Join the batch writer threads before the callback objects they call
+   * are released below. */
+  while (true) {
+    char *name;
+
+    pthread_mutex_lock(&batch_writers_lock);
+    if (batch_writers == NULL) {
+      pthread_mutex_unlock(&batch_writers_lock);
+      break;
+    }
+    name = sstrdup(batch_writers->cbi->name);
+    batch_writers = batch_writers->next;
+    pthread_mutex_unlock(&batch_writers_lock);
+
+    plugin_unregister_write(name);
+    sfree(name);
+  }
+
   /* Execute all the shutdown functions registered by plugins. */
   cjni_shutdown_plugins(jvm_env);
 
@@ -2842,6 +3243,6 @@ static int cjni_init(void) /* {{{ */
 
 void module_register(void) {
   plugin_register_complex_config("java", cjni_config_callback);
-  plugin_register_init("java", cjni_init);
+  plugin_register_init_concurrent("java", cjni_init, /* depends_on = */ NULL);
   plugin_register_shutdown("java", cjni_shutdown);
 } /* void module_register (void) */
@@ -104,6 +104,17 @@
     snprintf((c)->errbuf, sizeof((c)->errbuf), __VA_ARGS__);                   \
   } while (0)
 
+/* Size of a PUTVAL command and the number of commands lcc_putval_batch()
+ * writes before reading the responses. */
+#define LCC_PUTVAL_COMMAND_SIZE 1024
+#define LCC_PUTVAL_WINDOW 128
+
+/* Maximum size of a GETVALS command, staying below the line limit of the
+ * unixsock plugin, and the number of commands lcc_getvals() writes before
+ * reading the responses. */
+#define LCC_GETVALS_COMMAND_SIZE 4000
+#define LCC_GETVALS_WINDOW 16
+
 /*
  * Types
  */
@@ -715,14 +726,192 @@ int lcc_getval(lcc_connection_t *c, lcc_identifier_t *ident, /* {{{ */
   lcc_response_free(&res);
 
   return 0;
+#undef BAIL_OUT
 } /* }}} int lcc_getval */
 
-int lcc_putval(lcc_connection_t *c, const lcc_value_list_t *vl) /* {{{ */
-{
+/* Parses a GETVALS response line, "<identifier> <ds>=<value> ...". */
+static int lcc_parse_getvals_line(char *line, /* {{{ */
+                                  lcc_getvals_result_t *ret) {
+  size_t fields_num = 0;
+  char *ptr;
+
+  for (ptr = line; *ptr != 0; ptr++)
+    if (*ptr == '=')
+      fields_num++;
+
+  memset(ret, 0, sizeof(*ret));
+  if (fields_num == 0)
+    return 0;
+
+  ret->values = calloc(fields_num, sizeof(*ret->values));
+  ret->values_names = calloc(fields_num, sizeof(*ret->values_names));
+  if ((ret->values == NULL) || (ret->values_names == NULL))
+    return ENOMEM;
+
+  /* Skip the identifier. */
+  ptr = strchr(line, ' ');
+  while ((ptr != NULL) && (*ptr != 0)) {
+    while (*ptr == ' ')
+      ptr++;
+    if (*ptr == 0)
+      break;
+
+    char *key = ptr;
+    char *value = strchr(key, '=');
+    if (value == NULL)
+      return EILSEQ;
+    *value = 0;
+    value++;
+
+    char *endptr = NULL;
+    ret->values[ret->values_num] = strtod(value, &endptr);
+    if (endptr == value)
+      return EILSEQ;
+
+    ret->values_names[ret->values_num] = strdup(key);
+    if (ret->values_names[ret->values_num] == NULL)
+      return ENOMEM;
+    ret->values_num++;
+
+    ptr = endptr;
+  }
+
+  return 0;
+} /* }}} int lcc_parse_getvals_line */
+
+void lcc_getvals_free(lcc_getvals_result_t *results, /* {{{ */
+                      size_t results_num) {
+  if (results == NULL)
+    return;
+
+  for (size_t i = 0; i < results_num; i++) {
+    if (results[i].values_names != NULL)
+      for (size_t j = 0; j < results[i].values_num; j++)
+        free(results[i].values_names[j]);
+    free(results[i].values_names);
+    free(results[i].values);
+  }
+  free(results);
+} /* }}} void lcc_getvals_free */
+
+int lcc_getvals(lcc_connection_t *c, /* {{{ */
+                const lcc_identifier_t *idents, size_t idents_num,
+                lcc_getvals_result_t **ret_results) {
   char ident_str[6 * LCC_NAME_LEN];
   char ident_esc[12 * LCC_NAME_LEN];
-  char command[1024] = "";
-  lcc_response_t res;
+  char command[LCC_GETVALS_COMMAND_SIZE];
+  /* Number of identifiers in each command of the current window. */
+  size_t counts[LCC_GETVALS_WINDOW];
+  lcc_getvals_result_t *results;
+  size_t done = 0;
+
+  if ((c == NULL) || ((idents == NULL) && (idents_num > 0)) ||
+      (ret_results == NULL)) {
+    lcc_set_errno(c, EINVAL);
+    return -1;
+  }
+
+  if (c->fh == NULL) {
+    lcc_set_errno(c, EBADF);
+    return -1;
+  }
+
+  results = calloc(idents_num > 0 ? idents_num : 1, sizeof(*results));
+  if (results == NULL) {
+    lcc_set_errno(c, ENOMEM);
+    return -1;
+  }
+
+#define BAIL_OUT(e)                                                            \
+  do {                                                                         \
+    if ((e) != 0)                                                              \
+      lcc_set_errno(c, (e));                                                   \
+    lcc_getvals_free(results, idents_num);                                     \
+    return -1;                                                                 \
+  } while (0)
+
+  while (done < idents_num) {
+    size_t commands_num = 0;
+    size_t next = done;
+
+    /* Pack as many identifiers into each command as fit, then read the
+     * responses of the whole window. */
+    while ((commands_num < LCC_GETVALS_WINDOW) && (next < idents_num)) {
+      size_t command_len = strlen("GETVALS");
+      size_t count = 0;
+
+      SSTRCPY(command, "GETVALS");
+      while (next < idents_num) {
+        if (lcc_identifier_to_string(c, ident_str, sizeof(ident_str),
+                                     idents + next) != 0)
+          BAIL_OUT(0);
+        lcc_strescape(ident_esc, ident_str, sizeof(ident_esc));
+
+        size_t len = strlen(ident_esc);
+        if (command_len + 1 + len >= sizeof(command)) {
+          if (count == 0) {
+            LCC_SET_ERRSTR(c, "Identifier too long: %s", ident_str);
+            BAIL_OUT(0);
+          }
+          break;
+        }
+
+        command[command_len] = ' ';
+        memcpy(command + command_len + 1, ident_esc, len + 1);
+        command_len += 1 + len;
+        count++;
+        next++;
+      }
+
+      lcc_tracef("send:    --> %s\n", command);
+      if (fprintf(c->fh, "%s\r\n", command) < 0)
+        BAIL_OUT(errno);
+      counts[commands_num] = count;
+      commands_num++;
+    }
+    fflush(c->fh);
+
+    for (size_t i = 0; i < commands_num; i++) {
+      lcc_response_t res;
+      if (lcc_receive(c, &res) != 0)
+        BAIL_OUT(0);
+
+      if (res.status != 0) {
+        LCC_SET_ERRSTR(c, "Server error: %s", res.message);
+        lcc_response_free(&res);
+        BAIL_OUT(0);
+      }
+
+      if (res.lines_num != counts[i]) {
+        lcc_response_free(&res);
+        BAIL_OUT(EILSEQ);
+      }
+
+      for (size_t j = 0; j < res.lines_num; j++) {
+        int status = lcc_parse_getvals_line(res.lines[j], results + done + j);
+        if (status != 0) {
+          lcc_response_free(&res);
+          BAIL_OUT(status);
+        }
+      }
+      done += res.lines_num;
+      lcc_response_free(&res);
+    }
+  }
+
+#undef BAIL_OUT
+
+  *ret_results = results;
+  return 0;
+} /* }}} int lcc_getvals */
+
+/* Formats the PUTVAL command for `vl' into `buffer', which must be at least
+ * LCC_PUTVAL_COMMAND_SIZE bytes long. */
+static int lcc_format_putval(lcc_connection_t *c, /* {{{ */
+                             const lcc_value_list_t *vl, char *buffer) {
+  char ident_str[6 * LCC_NAME_LEN];
+  char ident_esc[12 * LCC_NAME_LEN];
+  char command[LCC_PUTVAL_COMMAND_SIZE] = "";
   int status;
 
   if ((c == NULL) || (vl == NULL) || (vl->values_len < 1) ||
@@ -762,6 +951,20 @@ int lcc_putval(lcc_connection_t *c, const lcc_value_list_t *vl) /* {{{ */
 
   } /* for (i = 0; i < vl->values_len; i++) */
 
+  memcpy(buffer, command, sizeof(command));
+  return 0;
+} /* }}} int lcc_format_putval */
+
+int lcc_putval(lcc_connection_t *c, const lcc_value_list_t *vl) /* {{{ */
+{
+  char command[LCC_PUTVAL_COMMAND_SIZE];
+  lcc_response_t res;
+  int status;
+
+  status = lcc_format_putval(c, vl, command);
+  if (status != 0)
+    return status;
+
   status = lcc_sendreceive(c, command, &res);
   if (status != 0)
     return status;
@@ -776,6 +979,68 @@ int lcc_putval(lcc_connection_t *c, const lcc_value_list_t *vl) /* {{{ */
   return 0;
 } /* }}} int lcc_putval */
 
+int lcc_putval_batch(lcc_connection_t *c, /* {{{ */
+                     const lcc_value_list_t *vls, size_t vls_num) {
+  char command[LCC_PUTVAL_COMMAND_SIZE];
+  char first_error[sizeof(c->errbuf)] = "";
+  size_t failed = 0;
+
+  if ((c == NULL) || ((vls == NULL) && (vls_num > 0))) {
+    lcc_set_errno(c, EINVAL);
+    return -1;
+  }
+
+  if (c->fh == NULL) {
+    lcc_set_errno(c, EBADF);
+    return -1;
+  }
+
+  for (size_t offset = 0; offset < vls_num; offset += LCC_PUTVAL_WINDOW) {
+    size_t num = vls_num - offset;
+    if (num > LCC_PUTVAL_WINDOW)
+      num = LCC_PUTVAL_WINDOW;
+
+    /* Write a window of commands, then read their responses. The window is
+     * small enough for the responses to fit into the socket buffer, so that
+     * the server never blocks writing them. */
+    size_t sent = 0;
+    for (size_t i = 0; i < num; i++) {
+      if (lcc_format_putval(c, vls + offset + i, command) != 0) {
+        if (failed++ == 0)
+          SSTRCPY(first_error, c->errbuf);
+        continue;
+      }
+
+      lcc_tracef("send:    --> %s\n", command);
+      if (fprintf(c->fh, "%s\r\n", command) < 0) {
+        lcc_set_errno(c, errno);
+        return -1;
+      }
+      sent++;
+    }
+    fflush(c->fh);
+
+    for (size_t i = 0; i < sent; i++) {
+      lcc_response_t res;
+      if (lcc_receive(c, &res) != 0)
+        return -1;
+
+      if ((res.status != 0) && (failed++ == 0))
+        snprintf(first_error, sizeof(first_error), "Server error: %s",
+                 res.message);
+      lcc_response_free(&res);
+    }
+  }
+
+  if (failed != 0) {
+    LCC_SET_ERRSTR(c, "%lu of %lu value lists failed: %s",
+                   (unsigned long)failed, (unsigned long)vls_num, first_error);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int lcc_putval_batch */
+
 int lcc_flush(lcc_connection_t *c, const char *plugin, /* {{{ */
               lcc_identifier_t *ident, int timeout) {
   char command[1024] = "";
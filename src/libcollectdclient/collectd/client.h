@@ -64,8 +64,31 @@ int lcc_getval(lcc_connection_t *c, lcc_identifier_t *ident,
                size_t *ret_values_num, gauge_t **ret_values,
                char ***ret_values_names);
 
+/* Values of one identifier as returned by lcc_getvals(). */
+struct lcc_getvals_result_s {
+  size_t values_num;
+  gauge_t *values;
+  char **values_names;
+};
+typedef struct lcc_getvals_result_s lcc_getvals_result_t;
+
+/* Retrieves the values of `idents_num' identifiers with as few GETVALS
+ * commands as possible. On success, `*ret_results' points to an array with
+ * one entry per identifier, in the same order, which must be freed with
+ * lcc_getvals_free(). Values that are not available are returned as NaN. */
+int lcc_getvals(lcc_connection_t *c, const lcc_identifier_t *idents,
+                size_t idents_num, lcc_getvals_result_t **ret_results);
+void lcc_getvals_free(lcc_getvals_result_t *results, size_t results_num);
+
 int lcc_putval(lcc_connection_t *c, const lcc_value_list_t *vl);
 
+/* Sends the PUTVAL commands for `vls_num' value lists, writing many commands
+ * before reading their responses. Returns zero if all value lists were
+ * dispatched. Otherwise returns -1; if only some of the value lists failed,
+ * the error message tells how many and why the first one failed. */
+int lcc_putval_batch(lcc_connection_t *c, const lcc_value_list_t *vls,
+                     size_t vls_num);
+
 int lcc_flush(lcc_connection_t *c, const char *plugin, lcc_identifier_t *ident,
               int timeout);
 
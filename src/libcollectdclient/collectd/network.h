@@ -67,11 +67,18 @@ int lcc_server_set_ttl(lcc_server_t *srv, uint8_t ttl);
 int lcc_server_set_interface(lcc_server_t *srv, char const *iface);
 int lcc_server_set_security_level(lcc_server_t *srv, lcc_security_level_t level,
                                   const char *username, const char *password);
+int lcc_server_set_compression(lcc_server_t *srv, int enable);
 
 /*
  * Send data
  */
 int lcc_network_values_send(lcc_network_t *net, const lcc_value_list_t *vl);
+/* Sends `num' value lists sharing one identifier prefix, see
+ * lcc_network_buffer_add_values(). */
+int lcc_network_values_send_batch(lcc_network_t *net,
+                                  const lcc_value_list_t *prefix,
+                                  const char *const *type_instances,
+                                  const value_t *values, size_t num);
 #if 0
 int lcc_network_notification_send (lcc_network_t *net,
     const lcc_notification_t *notif);
@@ -46,12 +46,31 @@ int lcc_network_buffer_set_security_level(lcc_network_buffer_t *nb,
                                           const char *user,
                                           const char *password);
 
+/* Sends the value lists in a zlib compressed part. Returns ENOTSUP if the
+ * library was built without zlib. */
+int lcc_network_buffer_set_compression(lcc_network_buffer_t *nb, int enable);
+
 int lcc_network_buffer_initialize(lcc_network_buffer_t *nb);
 int lcc_network_buffer_finalize(lcc_network_buffer_t *nb);
 
 int lcc_network_buffer_add_value(lcc_network_buffer_t *nb,
                                  const lcc_value_list_t *vl);
 
+/* Adds `num' value lists sharing the host, plugin, plugin instance, type, time
+ * and interval of `prefix', e.g. the counters of a device. Value list `i' has
+ * the type instance `type_instances[i]' and the `prefix->values_len' values
+ * starting at `values[i * prefix->values_len]', of the types given by
+ * `prefix->values_types'. `type_instances' may be NULL, meaning none; the
+ * type instance and values of `prefix' are ignored. The strings are not
+ * copied, apart from the last type instance. Stores the number of value lists
+ * added in `*ret_added' and returns ENOMEM if the buffer is full before all
+ * of them were added. */
+int lcc_network_buffer_add_values(lcc_network_buffer_t *nb,
+                                  const lcc_value_list_t *prefix,
+                                  const char *const *type_instances,
+                                  const value_t *values, size_t num,
+                                  size_t *ret_added);
+
 int lcc_network_buffer_get(lcc_network_buffer_t *nb, void *buffer,
                            size_t *buffer_size);
 
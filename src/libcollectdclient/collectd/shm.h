@@ -0,0 +1,83 @@
+/**
+ * collectd - src/libcollectdclient/collectd/shm.h
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef LIBCOLLECTD_SHM_H
+#define LIBCOLLECTD_SHM_H 1
+
+#include "collectd/lcc_features.h"
+
+#include "collectd/shm_format.h"
+#include "collectd/types.h"
+
+LCC_BEGIN_DECLS
+
+/* lcc_shm_value_t is a copy of a slot, as returned by lcc_shm_getval(). */
+typedef struct {
+  double time;
+  double interval;
+  size_t values_num;
+  int values_types[LCC_SHM_VALUES_MAX];
+  value_t values[LCC_SHM_VALUES_MAX];
+  double rates[LCC_SHM_VALUES_MAX];
+  char values_names[LCC_SHM_VALUES_MAX][LCC_SHM_DS_NAME_LEN];
+} lcc_shm_value_t;
+
+struct lcc_shm_s;
+typedef struct lcc_shm_s lcc_shm_t;
+
+/* lcc_shm_open maps the segment "name" read-only. If "name" is NULL,
+ * LCC_SHM_DEFAULT_NAME is used. Returns zero on success and an errno value
+ * otherwise; EPROTO means the segment is not in a format this library knows. */
+int lcc_shm_open(const char *name, lcc_shm_t **ret_shm);
+
+/* lcc_shm_close unmaps the segment and frees "shm". */
+void lcc_shm_close(lcc_shm_t *shm);
+
+/* lcc_shm_getval copies the last value of "ident" to "ret_value". Returns zero
+ * on success, ENOENT if the identifier is not in the table, ESTALE if the
+ * daemon has closed the segment and EAGAIN if the slot stayed locked. */
+int lcc_shm_getval(lcc_shm_t *shm, const lcc_identifier_t *ident,
+                   lcc_shm_value_t *ret_value);
+
+struct lcc_shm_ring_s;
+typedef struct lcc_shm_ring_s lcc_shm_ring_t;
+
+/* lcc_shm_ring_open maps the segment "name" of the shm_ring plugin and claims
+ * one of its rings. If "name" is NULL, LCC_SHM_RING_DEFAULT_NAME is used.
+ * Returns zero on success and an errno value otherwise; EBUSY means all rings
+ * are taken. A ring must only be used by one thread at a time. */
+int lcc_shm_ring_open(const char *name, lcc_shm_ring_t **ret_ring);
+
+/* lcc_shm_ring_close releases the ring, unmaps the segment and frees "ring".
+ * Values that have been put but not yet read are still dispatched. */
+void lcc_shm_ring_close(lcc_shm_ring_t *ring);
+
+/* lcc_shm_ring_putval passes "vl" to the daemon without blocking. Returns zero
+ * on success, ENOBUFS if the ring is full, ESTALE if the daemon has closed the
+ * segment (open it again) and EINVAL if "vl" has more than LCC_SHM_VALUES_MAX
+ * values. */
+int lcc_shm_ring_putval(lcc_shm_ring_t *ring, const lcc_value_list_t *vl);
+
+LCC_END_DECLS
+
+#endif /* LIBCOLLECTD_SHM_H */
@@ -0,0 +1,157 @@
+/**
+ * collectd - src/libcollectdclient/collectd/shm_format.h
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef LIBCOLLECTD_SHM_FORMAT_H
+#define LIBCOLLECTD_SHM_FORMAT_H 1
+
+/* This header only uses standard types, so that the daemon's write_shm plugin
+ * can include it next to its own definitions of value_t and friends. */
+
+#include <stdint.h>
+
+/*
+ * The write_shm plugin publishes the last value of each identifier in a
+ * shared memory segment, which local readers can map and search without
+ * talking to the daemon. The segment is a lcc_shm_header_t, followed by
+ * "slots_num" slots of "slot_size" bytes each.
+ *
+ * The slots form an open addressing hash table: the slot of an identifier is
+ * found by linear probing, starting at lcc_shm_hash() of its name modulo
+ * slots_num. A slot whose hash is zero is empty and ends the search. Slots are
+ * never freed while the segment is open.
+ *
+ * Each slot is protected by a sequence lock: the daemon increments "seq"
+ * before and after changing the slot, so readers copy a slot while "seq" is
+ * even and retry if it changed in the meantime.
+ */
+
+#define LCC_SHM_DEFAULT_NAME "/collectd"
+
+#define LCC_SHM_MAGIC 0x4c435348 /* "LCSH" */
+#define LCC_SHM_VERSION 1
+
+/* "state" of a segment. A segment is closed when the daemon shuts down or
+ * replaces it; readers should then open the segment again. */
+#define LCC_SHM_STATE_OPEN 1
+#define LCC_SHM_STATE_CLOSED 2
+
+#define LCC_SHM_NAME_LEN 256
+#define LCC_SHM_VALUES_MAX 8
+#define LCC_SHM_DS_NAME_LEN 32
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t state;
+  uint32_t slots_num;
+  uint32_t slot_size;
+  uint32_t reserved[11];
+} lcc_shm_header_t;
+
+typedef struct {
+  uint32_t seq;
+  uint32_t values_num;
+  uint64_t hash;
+  double time;
+  double interval;
+  int32_t values_types[LCC_SHM_VALUES_MAX];
+  /* The raw bits of the values, see value_t. */
+  uint64_t values[LCC_SHM_VALUES_MAX];
+  /* Gauges, and the per-second rates of all other data source types. */
+  double rates[LCC_SHM_VALUES_MAX];
+  char values_names[LCC_SHM_VALUES_MAX][LCC_SHM_DS_NAME_LEN];
+  /* The identifier as formatted by lcc_identifier_to_string(). */
+  char name[LCC_SHM_NAME_LEN];
+} lcc_shm_slot_t;
+
+/* lcc_shm_hash returns the 64 bit FNV-1a hash of "name", or one if that is
+ * zero. */
+static inline uint64_t lcc_shm_hash(const char *name) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (const unsigned char *p = (const unsigned char *)name; *p != 0; p++) {
+    hash ^= *p;
+    hash *= 0x100000001b3ULL;
+  }
+  return (hash == 0) ? 1 : hash;
+}
+
+/*
+ * The shm_ring plugin creates a segment of "rings_num" rings through which
+ * local producers pass values to the daemon. The segment is a
+ * lcc_shm_ring_header_t, followed by "rings_num" lcc_shm_ring_ctl_t and then,
+ * for each ring in turn, "ring_size" lcc_shm_record_t.
+ *
+ * A producer claims a ring by changing its "owner" from zero to its process
+ * ID. Each ring has a single producer and the daemon as its single consumer:
+ * the producer writes record "head % ring_size" and then increments "head",
+ * the daemon reads records until it reaches "head" and then advances "tail".
+ * "ring_size" is a power of two, so these counters may wrap.
+ */
+
+#define LCC_SHM_RING_DEFAULT_NAME "/collectd-ring"
+
+#define LCC_SHM_RING_MAGIC 0x4c435252 /* "LCRR" */
+#define LCC_SHM_RING_VERSION 1
+
+#define LCC_SHM_RECORD_NAME_LEN 64
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t state; /* LCC_SHM_STATE_OPEN or LCC_SHM_STATE_CLOSED */
+  uint32_t rings_num;
+  uint32_t ring_size;
+  uint32_t record_size;
+  uint32_t reserved[10];
+} lcc_shm_ring_header_t;
+
+/* The fields written by the producer and those written by the daemon are on
+ * separate cache lines. */
+typedef struct {
+  uint32_t owner;
+  uint32_t reserved0[15];
+
+  uint64_t head;
+  uint64_t dropped; /* records the producer found no room for */
+  uint64_t reserved1[6];
+
+  uint64_t tail;
+  uint64_t reserved2[7];
+} lcc_shm_ring_ctl_t;
+
+typedef struct {
+  char host[LCC_SHM_RECORD_NAME_LEN];
+  char plugin[LCC_SHM_RECORD_NAME_LEN];
+  char plugin_instance[LCC_SHM_RECORD_NAME_LEN];
+  char type[LCC_SHM_RECORD_NAME_LEN];
+  char type_instance[LCC_SHM_RECORD_NAME_LEN];
+  /* Zero means "now" and the daemon's interval, respectively. */
+  double time;
+  double interval;
+  uint32_t values_num;
+  uint32_t reserved;
+  /* The raw bits of the values, see value_t. */
+  uint64_t values[LCC_SHM_VALUES_MAX];
+} lcc_shm_record_t;
+
+#endif /* LIBCOLLECTD_SHM_FORMAT_H */
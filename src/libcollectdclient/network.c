@@ -254,6 +254,34 @@ static int server_value_add(lcc_server_t *srv, /* {{{ */
   return lcc_network_buffer_add_value(srv->buffer, vl);
 } /* }}} int server_value_add */
 
+static int server_values_add(lcc_server_t *srv, /* {{{ */
+                             const lcc_value_list_t *prefix,
+                             const char *const *type_instances,
+                             const value_t *values, size_t num) {
+  /* Whether the buffer has just been sent, i.e. is empty. */
+  bool sent = false;
+
+  while (42) {
+    size_t added = 0;
+    int status = lcc_network_buffer_add_values(srv->buffer, prefix,
+                                               type_instances, values, num,
+                                               &added);
+    if (status != ENOMEM)
+      return status;
+    /* Not even one value list fits into an empty buffer. */
+    if ((added == 0) && sent)
+      return ENOMEM;
+
+    if (type_instances != NULL)
+      type_instances += added;
+    values += added * prefix->values_len;
+    num -= added;
+
+    server_send_buffer(srv);
+    sent = true;
+  }
+} /* }}} int server_values_add */
+
 /*
  * Public functions
  */
@@ -440,6 +468,11 @@ int lcc_server_set_security_level(lcc_server_t *srv, /* {{{ */
                                                password);
 } /* }}} int lcc_server_set_security_level */
 
+int lcc_server_set_compression(lcc_server_t *srv, int enable) /* {{{ */
+{
+  return lcc_network_buffer_set_compression(srv->buffer, enable);
+} /* }}} int lcc_server_set_compression */
+
 int lcc_network_values_send(lcc_network_t *net, /* {{{ */
                             const lcc_value_list_t *vl) {
   if ((net == NULL) || (vl == NULL))
@@ -450,3 +483,21 @@ int lcc_network_values_send(lcc_network_t *net, /* {{{ */
 
   return 0;
 } /* }}} int lcc_network_values_send */
+
+int lcc_network_values_send_batch(lcc_network_t *net, /* {{{ */
+                                  const lcc_value_list_t *prefix,
+                                  const char *const *type_instances,
+                                  const value_t *values, size_t num) {
+  int status = 0;
+
+  if ((net == NULL) || (prefix == NULL))
+    return EINVAL;
+
+  for (lcc_server_t *srv = net->servers; srv != NULL; srv = srv->next) {
+    int tmp = server_values_add(srv, prefix, type_instances, values, num);
+    if (tmp != 0)
+      status = tmp;
+  }
+
+  return status;
+} /* }}} int lcc_network_values_send_batch */
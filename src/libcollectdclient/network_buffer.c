@@ -63,6 +63,10 @@ GCRY_THREAD_OPTION_PTHREAD_IMPL;
 #endif
 #endif
 
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 #include "collectd/network_buffer.h"
 
 #define TYPE_HOST 0x0000
@@ -83,8 +87,17 @@ GCRY_THREAD_OPTION_PTHREAD_IMPL;
 #define TYPE_SIGN_SHA256 0x0200
 #define TYPE_ENCR_AES256 0x0210
 
+/* Deflate (zlib) compressed run of the parts above */
+#define TYPE_COMPR_ZLIB 0x0220
+
 #define PART_SIGNATURE_SHA256_SIZE 36
 #define PART_ENCRYPTION_AES256_SIZE 42
+#define PART_COMPRESSION_ZLIB_SIZE 4
+
+/* Worst case size of the zlib header and trailer and of the blocks' headers
+ * added by a sync flush. See nb_compr_room(). */
+#define COMPR_STREAM_OVERHEAD 8
+#define COMPR_FLUSH_OVERHEAD 16
 
 #define ADD_GENERIC(nb, srcptr, size)                                          \
   do {                                                                         \
@@ -116,6 +129,17 @@ struct lcc_network_buffer_s {
   size_t encr_header_len;
   char encr_iv[16];
 #endif
+
+#if HAVE_ZLIB
+  /* With compression, value lists are added to `compr_pending' and deflated
+   * into the buffer, behind the part header at `compr_header', whenever the
+   * next value list might not fit uncompressed. */
+  bool compress;
+  z_stream compr_stream;
+  char *compr_header;
+  char *compr_pending;
+  size_t compr_pending_fill;
+#endif
 };
 
 #define SSTRNCPY(dst, src, sz)                                                 \
@@ -145,7 +169,7 @@ static bool have_gcrypt(void) /* {{{ */
   if (!gcry_check_version(GCRYPT_VERSION))
     return false;
 
-  if (!gcry_control(GCRYCTL_INIT_SECMEM, 32768, 0))
+  if (gcry_control(GCRYCTL_INIT_SECMEM, 32768, 0))
     return false;
 
   gcry_control(GCRYCTL_INITIALIZATION_FINISHED, 0);
@@ -258,9 +282,11 @@ static double htond(double val) /* {{{ */
   }
 } /* }}} double htond */
 
+/* Writes a values part directly into `*ret_buffer'. */
 static int nb_add_values(char **ret_buffer, /* {{{ */
-                         size_t *ret_buffer_len, const lcc_value_list_t *vl) {
-  if ((vl == NULL) || (vl->values_len < 1)) {
+                         size_t *ret_buffer_len, size_t values_len,
+                         const int *values_types, const value_t *values) {
+  if ((values_len < 1) || (values_types == NULL) || (values == NULL)) {
     return EINVAL;
   }
 
@@ -270,64 +296,57 @@ static int nb_add_values(char **ret_buffer, /* {{{ */
   uint16_t pkg_type;
   uint16_t pkg_length;
   uint16_t pkg_num_values;
-  uint8_t pkg_values_types[vl->values_len];
-  value_t pkg_values[vl->values_len];
-
-  size_t offset;
 
   packet_len = sizeof(pkg_type) + sizeof(pkg_length) + sizeof(pkg_num_values) +
-               sizeof(pkg_values_types) + sizeof(pkg_values);
+               values_len * (sizeof(uint8_t) + sizeof(value_t));
 
   if (*ret_buffer_len < packet_len)
     return ENOMEM;
 
   pkg_type = htons(TYPE_VALUES);
   pkg_length = htons((uint16_t)packet_len);
-  pkg_num_values = htons((uint16_t)vl->values_len);
+  pkg_num_values = htons((uint16_t)values_len);
+
+  /*
+   * Use `memcpy' to write everything to the buffer, because the pointer
+   * may be unaligned and some architectures, such as SPARC, can't handle
+   * that.
+   */
+  packet_ptr = *ret_buffer;
+  memcpy(packet_ptr, &pkg_type, sizeof(pkg_type));
+  memcpy(packet_ptr + 2, &pkg_length, sizeof(pkg_length));
+  memcpy(packet_ptr + 4, &pkg_num_values, sizeof(pkg_num_values));
+
+  uint8_t *types_ptr = (uint8_t *)packet_ptr + 6;
+  char *values_ptr = packet_ptr + 6 + values_len;
 
-  for (size_t i = 0; i < vl->values_len; i++) {
-    pkg_values_types[i] = (uint8_t)vl->values_types[i];
-    switch (vl->values_types[i]) {
+  for (size_t i = 0; i < values_len; i++) {
+    value_t tmp;
+
+    types_ptr[i] = (uint8_t)values_types[i];
+    switch (values_types[i]) {
     case LCC_TYPE_COUNTER:
-      pkg_values[i].counter = (counter_t)htonll(vl->values[i].counter);
+      tmp.counter = (counter_t)htonll(values[i].counter);
       break;
 
     case LCC_TYPE_GAUGE:
-      pkg_values[i].gauge = (gauge_t)htond(vl->values[i].gauge);
+      tmp.gauge = (gauge_t)htond(values[i].gauge);
       break;
 
     case LCC_TYPE_DERIVE:
-      pkg_values[i].derive = (derive_t)htonll(vl->values[i].derive);
+      tmp.derive = (derive_t)htonll(values[i].derive);
       break;
 
     case LCC_TYPE_ABSOLUTE:
-      pkg_values[i].absolute = (absolute_t)htonll(vl->values[i].absolute);
+      tmp.absolute = (absolute_t)htonll(values[i].absolute);
       break;
 
     default:
       return EINVAL;
-    } /* switch (vl->values_types[i]) */
-  }   /* for (vl->values_len) */
-
-  /*
-   * Use `memcpy' to write everything to the buffer, because the pointer
-   * may be unaligned and some architectures, such as SPARC, can't handle
-   * that.
-   */
-  packet_ptr = *ret_buffer;
-  offset = 0;
-  memcpy(packet_ptr + offset, &pkg_type, sizeof(pkg_type));
-  offset += sizeof(pkg_type);
-  memcpy(packet_ptr + offset, &pkg_length, sizeof(pkg_length));
-  offset += sizeof(pkg_length);
-  memcpy(packet_ptr + offset, &pkg_num_values, sizeof(pkg_num_values));
-  offset += sizeof(pkg_num_values);
-  memcpy(packet_ptr + offset, pkg_values_types, sizeof(pkg_values_types));
-  offset += sizeof(pkg_values_types);
-  memcpy(packet_ptr + offset, pkg_values, sizeof(pkg_values));
-  offset += sizeof(pkg_values);
+    } /* switch (values_types[i]) */
 
-  assert(offset == packet_len);
+    memcpy(values_ptr + i * sizeof(tmp), &tmp, sizeof(tmp));
+  } /* for (values_len) */
 
   *ret_buffer = packet_ptr + packet_len;
   *ret_buffer_len -= packet_len;
@@ -414,10 +433,13 @@ static int nb_add_string(char **ret_buffer, /* {{{ */
   return 0;
 } /* }}} int nb_add_string */
 
-static int nb_add_value_list(lcc_network_buffer_t *nb, /* {{{ */
-                             const lcc_value_list_t *vl) {
-  char *buffer = nb->ptr;
-  size_t buffer_size = nb->free;
+/* Adds the parts for the host, plugin, plugin instance, type, time and
+ * interval of `vl' that differ from the state. */
+static int nb_add_prefix(lcc_network_buffer_t *nb, /* {{{ */
+                         char **ret_buffer, size_t *ret_buffer_size,
+                         const lcc_value_list_t *vl) {
+  char *buffer = *ret_buffer;
+  size_t buffer_size = *ret_buffer_size;
 
   const lcc_identifier_t *ident_src;
   lcc_identifier_t *ident_dst;
@@ -455,15 +477,6 @@ static int nb_add_value_list(lcc_network_buffer_t *nb, /* {{{ */
     SSTRNCPY(ident_dst->type, ident_src->type, sizeof(ident_dst->type));
   }
 
-  if (strcmp(ident_dst->type_instance, ident_src->type_instance) != 0) {
-    if (nb_add_string(&buffer, &buffer_size, TYPE_TYPE_INSTANCE,
-                      ident_src->type_instance,
-                      strlen(ident_src->type_instance)) != 0)
-      return -1;
-    SSTRNCPY(ident_dst->type_instance, ident_src->type_instance,
-             sizeof(ident_dst->type_instance));
-  }
-
   if (nb->state.time != vl->time) {
     if (nb_add_time(&buffer, &buffer_size, TYPE_TIME_HR, vl->time))
       return -1;
@@ -476,14 +489,202 @@ static int nb_add_value_list(lcc_network_buffer_t *nb, /* {{{ */
     nb->state.interval = vl->interval;
   }
 
-  if (nb_add_values(&buffer, &buffer_size, vl) != 0)
+  *ret_buffer = buffer;
+  *ret_buffer_size = buffer_size;
+  return 0;
+} /* }}} int nb_add_prefix */
+
+/* Adds the parts for `vl' to `*ret_buffer' and advances it. */
+static int nb_add_value_list(lcc_network_buffer_t *nb, /* {{{ */
+                             char **ret_buffer, size_t *ret_buffer_size,
+                             const lcc_value_list_t *vl) {
+  char *buffer = *ret_buffer;
+  size_t buffer_size = *ret_buffer_size;
+
+  const char *ti_src = vl->identifier.type_instance;
+  char *ti_dst = nb->state.identifier.type_instance;
+
+  if (nb_add_prefix(nb, &buffer, &buffer_size, vl) != 0)
+    return -1;
+
+  if (strcmp(ti_dst, ti_src) != 0) {
+    if (nb_add_string(&buffer, &buffer_size, TYPE_TYPE_INSTANCE, ti_src,
+                      strlen(ti_src)) != 0)
+      return -1;
+    SSTRNCPY(ti_dst, ti_src, sizeof(nb->state.identifier.type_instance));
+  }
+
+  if (nb_add_values(&buffer, &buffer_size, vl->values_len, vl->values_types,
+                    vl->values) != 0)
     return -1;
 
-  nb->ptr = buffer;
-  nb->free = buffer_size;
+  *ret_buffer = buffer;
+  *ret_buffer_size = buffer_size;
   return 0;
 } /* }}} int nb_add_value_list */
 
+/* Adds as many of the value lists described by `prefix', `type_instances' and
+ * `values' as fit into `*ret_buffer', see lcc_network_buffer_add_values().
+ * The type instances are compared with the previous one, not with a copy, and
+ * only the last one is copied to the state. Returns the number of value lists
+ * added. */
+static size_t nb_add_values_prefixed(lcc_network_buffer_t *nb, /* {{{ */
+                                     char **ret_buffer,
+                                     size_t *ret_buffer_size,
+                                     const lcc_value_list_t *prefix,
+                                     const char *const *type_instances,
+                                     const value_t *values, size_t num) {
+  char *buffer = *ret_buffer;
+  size_t buffer_size = *ret_buffer_size;
+
+  /* nb_add_prefix() updates the state as it goes, even if it fails. */
+  lcc_value_list_t state = nb->state;
+  if (nb_add_prefix(nb, &buffer, &buffer_size, prefix) != 0) {
+    nb->state = state;
+    return 0;
+  }
+
+  const char *ti_prev = nb->state.identifier.type_instance;
+  size_t added = 0;
+
+  for (; added < num; added++) {
+    const char *ti = (type_instances != NULL) ? type_instances[added] : "";
+    const value_t *v = values + added * prefix->values_len;
+
+    char *ptr = buffer;
+    size_t ptr_size = buffer_size;
+
+    if ((ti != ti_prev) && (strcmp(ti, ti_prev) != 0) &&
+        (nb_add_string(&ptr, &ptr_size, TYPE_TYPE_INSTANCE, ti, strlen(ti)) !=
+         0))
+      break;
+    if (nb_add_values(&ptr, &ptr_size, prefix->values_len,
+                      prefix->values_types, v) != 0)
+      break;
+
+    ti_prev = ti;
+    buffer = ptr;
+    buffer_size = ptr_size;
+  }
+
+  if (added == 0) {
+    nb->state = state;
+    return 0;
+  }
+
+  if (ti_prev != nb->state.identifier.type_instance)
+    SSTRNCPY(nb->state.identifier.type_instance, ti_prev,
+             sizeof(nb->state.identifier.type_instance));
+
+  *ret_buffer = buffer;
+  *ret_buffer_size = buffer_size;
+  return added;
+} /* }}} size_t nb_add_values_prefixed */
+
+#if HAVE_ZLIB
+/* Returns how many bytes of parts may be added to `compr_pending' without
+ * risking that the compressed part overflows the buffer. */
+static size_t nb_compr_room(const lcc_network_buffer_t *nb) /* {{{ */
+{
+  size_t used = nb->compr_pending_fill + COMPR_STREAM_OVERHEAD +
+                COMPR_FLUSH_OVERHEAD;
+
+  return (used < nb->free) ? (nb->free - used) : 0;
+} /* }}} size_t nb_compr_room */
+
+/* Compresses the pending parts. `flush' is either Z_SYNC_FLUSH or Z_FINISH. */
+static int nb_compr_deflate(lcc_network_buffer_t *nb, int flush) /* {{{ */
+{
+  int status;
+
+  nb->compr_stream.next_in = (Bytef *)nb->compr_pending;
+  nb->compr_stream.avail_in = (uInt)nb->compr_pending_fill;
+  nb->compr_stream.next_out = (Bytef *)nb->ptr;
+  nb->compr_stream.avail_out = (uInt)nb->free;
+
+  status = deflate(&nb->compr_stream, flush);
+  if ((nb->compr_stream.avail_in != 0) ||
+      (status != ((flush == Z_FINISH) ? Z_STREAM_END : Z_OK)))
+    return -1;
+
+  nb->ptr = (char *)nb->compr_stream.next_out;
+  nb->free = (size_t)nb->compr_stream.avail_out;
+  nb->compr_pending_fill = 0;
+  return 0;
+} /* }}} int nb_compr_deflate */
+
+static int nb_compr_add_value_list(lcc_network_buffer_t *nb, /* {{{ */
+                                   const lcc_value_list_t *vl) {
+  while (42) {
+    /* nb_add_value_list() updates the state as it goes, even if it fails. */
+    lcc_value_list_t state = nb->state;
+    char *buffer = nb->compr_pending + nb->compr_pending_fill;
+    size_t buffer_size = nb_compr_room(nb);
+
+    if (nb_add_value_list(nb, &buffer, &buffer_size, vl) == 0) {
+      nb->compr_pending_fill = (size_t)(buffer - nb->compr_pending);
+      return 0;
+    }
+    nb->state = state;
+
+    /* Compressing the pending parts makes room for more. If nothing is
+     * pending, the buffer is full. */
+    if ((nb->compr_pending_fill == 0) ||
+        (nb_compr_deflate(nb, Z_SYNC_FLUSH) != 0))
+      return -1;
+  }
+} /* }}} int nb_compr_add_value_list */
+
+static size_t nb_compr_add_values_prefixed(/* {{{ */
+                                           lcc_network_buffer_t *nb,
+                                           const lcc_value_list_t *prefix,
+                                           const char *const *type_instances,
+                                           const value_t *values, size_t num) {
+  size_t added = 0;
+
+  while (added < num) {
+    char *buffer = nb->compr_pending + nb->compr_pending_fill;
+    size_t buffer_size = nb_compr_room(nb);
+
+    added += nb_add_values_prefixed(
+        nb, &buffer, &buffer_size, prefix,
+        (type_instances != NULL) ? type_instances + added : NULL,
+        values + added * prefix->values_len, num - added);
+    nb->compr_pending_fill = (size_t)(buffer - nb->compr_pending);
+    if (added == num)
+      break;
+
+    if ((nb->compr_pending_fill == 0) ||
+        (nb_compr_deflate(nb, Z_SYNC_FLUSH) != 0))
+      break;
+  }
+
+  return added;
+} /* }}} size_t nb_compr_add_values_prefixed */
+
+static int nb_compr_finalize(lcc_network_buffer_t *nb) /* {{{ */
+{
+  uint16_t pkg_type = htons(TYPE_COMPR_ZLIB);
+  uint16_t pkg_length;
+
+  /* Don't send an empty compressed part. */
+  if ((nb->compr_pending_fill == 0) && (nb->compr_stream.total_out == 0)) {
+    nb->ptr = nb->compr_header;
+    nb->free += PART_COMPRESSION_ZLIB_SIZE;
+    return 0;
+  }
+
+  if (nb_compr_deflate(nb, Z_FINISH) != 0)
+    return -1;
+
+  pkg_length = htons((uint16_t)(nb->ptr - nb->compr_header));
+  memcpy(nb->compr_header, &pkg_type, sizeof(pkg_type));
+  memcpy(nb->compr_header + sizeof(pkg_type), &pkg_length,
+         sizeof(pkg_length));
+  return 0;
+} /* }}} int nb_compr_finalize */
+#endif /* HAVE_ZLIB */
+
 #if HAVE_GCRYPT_H
 static int nb_add_signature(lcc_network_buffer_t *nb) /* {{{ */
 {
@@ -548,7 +749,7 @@ static int nb_add_encryption(lcc_network_buffer_t *nb) /* {{{ */
   memcpy(nb->buffer + 2, &pkg_length, sizeof(pkg_length));
 
   /* Calculate what to hash */
-  hash_ptr = nb->buffer + PART_ENCRYPTION_AES256_SIZE;
+  hash_ptr = nb->buffer + nb->encr_header_len;
   hash_size = package_length - nb->encr_header_len;
 
   /* Calculate what to encrypt */
@@ -645,6 +846,12 @@ void lcc_network_buffer_destroy(lcc_network_buffer_t *nb) /* {{{ */
   if (nb == NULL)
     return;
 
+#if HAVE_ZLIB
+  if (nb->compr_pending != NULL) {
+    deflateEnd(&nb->compr_stream);
+    free(nb->compr_pending);
+  }
+#endif
   free(nb->buffer);
   free(nb);
 } /* }}} void lcc_network_buffer_destroy */
@@ -687,6 +894,32 @@ int lcc_network_buffer_set_security_level(lcc_network_buffer_t *nb, /* {{{ */
   return 0;
 } /* }}} int lcc_network_buffer_set_security_level */
 
+int lcc_network_buffer_set_compression(lcc_network_buffer_t *nb, /* {{{ */
+                                       int enable) {
+  if (nb == NULL)
+    return EINVAL;
+
+#if HAVE_ZLIB
+  if (enable && (nb->compr_pending == NULL)) {
+    nb->compr_pending = malloc(nb->size);
+    if (nb->compr_pending == NULL)
+      return ENOMEM;
+
+    if (deflateInit(&nb->compr_stream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+      free(nb->compr_pending);
+      nb->compr_pending = NULL;
+      return ENOMEM;
+    }
+  }
+
+  nb->compress = (enable != 0);
+  lcc_network_buffer_initialize(nb);
+  return 0;
+#else
+  return enable ? ENOTSUP : 0;
+#endif
+} /* }}} int lcc_network_buffer_set_compression */
+
 int lcc_network_buffer_initialize(lcc_network_buffer_t *nb) /* {{{ */
 {
   if (nb == NULL)
@@ -740,6 +973,18 @@ int lcc_network_buffer_initialize(lcc_network_buffer_t *nb) /* {{{ */
   }
 #endif
 
+#if HAVE_ZLIB
+  if (nb->compress) {
+    /* Filled in in finalize. */
+    char header[PART_COMPRESSION_ZLIB_SIZE] = {0};
+
+    deflateReset(&nb->compr_stream);
+    nb->compr_pending_fill = 0;
+    nb->compr_header = nb->ptr;
+    ADD_GENERIC(nb, header, sizeof(header));
+  }
+#endif
+
   return 0;
 } /* }}} int lcc_network_buffer_initialize */
 
@@ -748,6 +993,11 @@ int lcc_network_buffer_finalize(lcc_network_buffer_t *nb) /* {{{ */
   if (nb == NULL)
     return EINVAL;
 
+#if HAVE_ZLIB
+  if (nb->compress && (nb_compr_finalize(nb) != 0))
+    return -1;
+#endif
+
 #if HAVE_GCRYPT_H
   if (nb->seclevel == SIGN)
     return nb_add_signature(nb);
@@ -765,10 +1015,48 @@ int lcc_network_buffer_add_value(lcc_network_buffer_t *nb, /* {{{ */
   if ((nb == NULL) || (vl == NULL))
     return EINVAL;
 
-  status = nb_add_value_list(nb, vl);
+#if HAVE_ZLIB
+  if (nb->compress)
+    return nb_compr_add_value_list(nb, vl);
+#endif
+
+  status = nb_add_value_list(nb, &nb->ptr, &nb->free, vl);
   return status;
 } /* }}} int lcc_network_buffer_add_value */
 
+int lcc_network_buffer_add_values(lcc_network_buffer_t *nb, /* {{{ */
+                                  const lcc_value_list_t *prefix,
+                                  const char *const *type_instances,
+                                  const value_t *values, size_t num,
+                                  size_t *ret_added) {
+  size_t added = 0;
+
+  if (ret_added != NULL)
+    *ret_added = 0;
+
+  if ((nb == NULL) || (prefix == NULL) || (prefix->values_len < 1) ||
+      (prefix->values_types == NULL) || ((values == NULL) && (num > 0)))
+    return EINVAL;
+
+  for (size_t i = 0; i < prefix->values_len; i++)
+    if ((prefix->values_types[i] < LCC_TYPE_COUNTER) ||
+        (prefix->values_types[i] > LCC_TYPE_ABSOLUTE))
+      return EINVAL;
+
+#if HAVE_ZLIB
+  if (nb->compress)
+    added = nb_compr_add_values_prefixed(nb, prefix, type_instances, values,
+                                         num);
+  else
+#endif
+    added = nb_add_values_prefixed(nb, &nb->ptr, &nb->free, prefix,
+                                   type_instances, values, num);
+
+  if (ret_added != NULL)
+    *ret_added = added;
+  return (added == num) ? 0 : ENOMEM;
+} /* }}} int lcc_network_buffer_add_values */
+
 int lcc_network_buffer_get(lcc_network_buffer_t *nb, /* {{{ */
                            void *buffer, size_t *buffer_size) {
   size_t sz_required;
@@ -0,0 +1,378 @@
+/**
+ * collectd - src/libcollectdclient/shm.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifdef WIN32
+#include "gnulib_config.h"
+#endif
+
+#include "config.h"
+
+#if !defined(__GNUC__) || !__GNUC__
+#define __attribute__(x) /**/
+#endif
+
+#include "collectd/client.h"
+#include "collectd/lcc_features.h"
+#include "collectd/shm.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if HAVE_SHM_OPEN
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifndef EPROTO
+#define EPROTO EINVAL
+#endif
+
+/* Number of times a reader retries a slot that is being written to. Writing a
+ * slot takes well below a microsecond, so running out of retries means the
+ * writer died while holding the lock. */
+#define LCC_SHM_RETRIES 10000
+
+struct lcc_shm_s {
+  void *addr;
+  size_t size;
+  lcc_shm_header_t const *header;
+  unsigned char const *slots;
+  uint32_t slots_num;
+  uint32_t slot_size;
+};
+
+struct lcc_shm_ring_s {
+  void *addr;
+  size_t size;
+  lcc_shm_ring_header_t const *header;
+  lcc_shm_ring_ctl_t *ctl;
+  unsigned char *records;
+  uint64_t ring_size;
+  uint32_t record_size;
+};
+
+#if HAVE_SHM_OPEN
+/* Maps the segment "name" and checks it holds at least "min_size" bytes. */
+static int shm_map(const char *name, int writable, size_t min_size, /* {{{ */
+                   void **ret_addr, size_t *ret_size) {
+  int fd = shm_open(name, writable ? O_RDWR : O_RDONLY, 0);
+  if (fd < 0)
+    return errno;
+
+  struct stat st = {0};
+  if (fstat(fd, &st) != 0) {
+    int status = errno;
+    close(fd);
+    return status;
+  }
+  if ((size_t)st.st_size < min_size) {
+    close(fd);
+    return EPROTO;
+  }
+
+  size_t size = (size_t)st.st_size;
+  int prot = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+  void *addr = mmap(NULL, size, prot, MAP_SHARED, fd, 0);
+  int status = errno;
+  close(fd);
+  if (addr == MAP_FAILED)
+    return status;
+
+  *ret_addr = addr;
+  *ret_size = size;
+  return 0;
+} /* }}} int shm_map */
+
+int lcc_shm_open(const char *name, lcc_shm_t **ret_shm) /* {{{ */
+{
+  if (ret_shm == NULL)
+    return EINVAL;
+  if (name == NULL)
+    name = LCC_SHM_DEFAULT_NAME;
+
+  void *addr = NULL;
+  size_t size = 0;
+  int status = shm_map(name, 0, sizeof(lcc_shm_header_t), &addr, &size);
+  if (status != 0)
+    return status;
+
+  lcc_shm_header_t const *header = addr;
+  uint32_t slots_num = header->slots_num;
+  uint32_t slot_size = header->slot_size;
+  if ((header->magic != LCC_SHM_MAGIC) ||
+      (header->version != LCC_SHM_VERSION) ||
+      (slot_size < sizeof(lcc_shm_slot_t)) || (slots_num == 0) ||
+      ((size - sizeof(*header)) / slot_size < slots_num)) {
+    munmap(addr, size);
+    return EPROTO;
+  }
+
+  lcc_shm_t *shm = calloc(1, sizeof(*shm));
+  if (shm == NULL) {
+    munmap(addr, size);
+    return ENOMEM;
+  }
+  shm->addr = addr;
+  shm->size = size;
+  shm->header = header;
+  shm->slots = (unsigned char const *)addr + sizeof(*header);
+  shm->slots_num = slots_num;
+  shm->slot_size = slot_size;
+
+  *ret_shm = shm;
+  return 0;
+} /* }}} int lcc_shm_open */
+
+void lcc_shm_close(lcc_shm_t *shm) /* {{{ */
+{
+  if (shm == NULL)
+    return;
+
+  munmap(shm->addr, shm->size);
+  free(shm);
+} /* }}} void lcc_shm_close */
+
+/* Copies the slot to "ret" and returns zero if it holds "name", ENOENT if it
+ * holds another identifier and EAGAIN if it stayed locked. "*empty" is set
+ * when the slot is unused. */
+static int shm_read_slot(lcc_shm_slot_t const *slot, /* {{{ */
+                         const char *name, uint64_t hash, lcc_shm_slot_t *ret,
+                         int *empty) {
+  for (int i = 0; i < LCC_SHM_RETRIES; i++) {
+    uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if (seq & 1)
+      continue;
+
+    uint64_t slot_hash = __atomic_load_n(&slot->hash, __ATOMIC_RELAXED);
+    *empty = (slot_hash == 0);
+    if (slot_hash != hash) {
+      /* Slots only change from empty to used, so a stale read is harmless:
+       * the identifier was not there when the search started. */
+      return ENOENT;
+    }
+
+    memcpy(ret, slot, sizeof(*ret));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq)
+      continue;
+
+    ret->name[sizeof(ret->name) - 1] = 0;
+    return (strcmp(ret->name, name) == 0) ? 0 : ENOENT;
+  }
+
+  return EAGAIN;
+} /* }}} int shm_read_slot */
+
+int lcc_shm_getval(lcc_shm_t *shm, const lcc_identifier_t *ident, /* {{{ */
+                   lcc_shm_value_t *ret_value) {
+  if ((shm == NULL) || (ident == NULL) || (ret_value == NULL))
+    return EINVAL;
+
+  if (__atomic_load_n(&shm->header->state, __ATOMIC_ACQUIRE) !=
+      LCC_SHM_STATE_OPEN)
+    return ESTALE;
+
+  char name[LCC_SHM_NAME_LEN];
+  if (lcc_identifier_to_string(NULL, name, sizeof(name), ident) != 0)
+    return EINVAL;
+  uint64_t hash = lcc_shm_hash(name);
+
+  lcc_shm_slot_t slot;
+  int found = 0;
+  for (uint32_t i = 0; (i < shm->slots_num) && !found; i++) {
+    size_t index = (size_t)((hash + i) % shm->slots_num);
+    lcc_shm_slot_t const *s =
+        (lcc_shm_slot_t const *)(shm->slots + index * shm->slot_size);
+
+    int empty = 0;
+    int status = shm_read_slot(s, name, hash, &slot, &empty);
+    if (status == 0)
+      found = 1;
+    else if ((status != ENOENT) || empty)
+      return status;
+  }
+  if (!found)
+    return ENOENT;
+
+  size_t values_num = slot.values_num;
+  if (values_num > LCC_SHM_VALUES_MAX)
+    values_num = LCC_SHM_VALUES_MAX;
+
+  *ret_value = (lcc_shm_value_t){
+      .time = slot.time,
+      .interval = slot.interval,
+      .values_num = values_num,
+  };
+  for (size_t i = 0; i < values_num; i++) {
+    ret_value->values_types[i] = (int)slot.values_types[i];
+    memcpy(&ret_value->values[i], &slot.values[i], sizeof(slot.values[i]));
+    ret_value->rates[i] = slot.rates[i];
+    memcpy(ret_value->values_names[i], slot.values_names[i],
+           LCC_SHM_DS_NAME_LEN);
+    ret_value->values_names[i][LCC_SHM_DS_NAME_LEN - 1] = 0;
+  }
+
+  return 0;
+} /* }}} int lcc_shm_getval */
+
+int lcc_shm_ring_open(const char *name, lcc_shm_ring_t **ret_ring) /* {{{ */
+{
+  if (ret_ring == NULL)
+    return EINVAL;
+  if (name == NULL)
+    name = LCC_SHM_RING_DEFAULT_NAME;
+
+  void *addr = NULL;
+  size_t size = 0;
+  int status = shm_map(name, 1, sizeof(lcc_shm_ring_header_t), &addr, &size);
+  if (status != 0)
+    return status;
+
+  lcc_shm_ring_header_t const *header = addr;
+  uint64_t rings_num = header->rings_num;
+  uint64_t ring_size = header->ring_size;
+  uint64_t record_size = header->record_size;
+  /* All factors are 32 bit wide, so these products cannot overflow. */
+  uint64_t ctl_size = rings_num * sizeof(lcc_shm_ring_ctl_t);
+  uint64_t records_size = rings_num * ring_size * record_size;
+  if ((header->magic != LCC_SHM_RING_MAGIC) ||
+      (header->version != LCC_SHM_RING_VERSION) || (rings_num == 0) ||
+      (ring_size == 0) || ((ring_size & (ring_size - 1)) != 0) ||
+      (record_size < sizeof(lcc_shm_record_t)) ||
+      (size - sizeof(*header) < ctl_size) ||
+      (size - sizeof(*header) - ctl_size < records_size)) {
+    munmap(addr, size);
+    return EPROTO;
+  }
+
+  lcc_shm_ring_ctl_t *ctls =
+      (lcc_shm_ring_ctl_t *)((unsigned char *)addr + sizeof(*header));
+  uint32_t pid = (uint32_t)getpid();
+  uint64_t index = 0;
+  for (index = 0; index < rings_num; index++) {
+    uint32_t expected = 0;
+    if (__atomic_compare_exchange_n(&ctls[index].owner, &expected, pid,
+                                    /* weak = */ 0, __ATOMIC_ACQUIRE,
+                                    __ATOMIC_RELAXED))
+      break;
+  }
+  if (index == rings_num) {
+    munmap(addr, size);
+    return EBUSY;
+  }
+
+  lcc_shm_ring_t *ring = calloc(1, sizeof(*ring));
+  if (ring == NULL) {
+    __atomic_store_n(&ctls[index].owner, 0, __ATOMIC_RELEASE);
+    munmap(addr, size);
+    return ENOMEM;
+  }
+  ring->addr = addr;
+  ring->size = size;
+  ring->header = header;
+  ring->ctl = ctls + index;
+  ring->records = (unsigned char *)(ctls + rings_num) +
+                  (size_t)(index * ring_size * record_size);
+  ring->ring_size = ring_size;
+  ring->record_size = (uint32_t)record_size;
+
+  *ret_ring = ring;
+  return 0;
+} /* }}} int lcc_shm_ring_open */
+
+void lcc_shm_ring_close(lcc_shm_ring_t *ring) /* {{{ */
+{
+  if (ring == NULL)
+    return;
+
+  __atomic_store_n(&ring->ctl->owner, 0, __ATOMIC_RELEASE);
+  munmap(ring->addr, ring->size);
+  free(ring);
+} /* }}} void lcc_shm_ring_close */
+
+static void ring_copy_name(char *dest, const char *src) {
+  memcpy(dest, src, LCC_SHM_RECORD_NAME_LEN);
+  dest[LCC_SHM_RECORD_NAME_LEN - 1] = 0;
+}
+
+int lcc_shm_ring_putval(lcc_shm_ring_t *ring, /* {{{ */
+                        const lcc_value_list_t *vl) {
+  if ((ring == NULL) || (vl == NULL) || (vl->values_len > LCC_SHM_VALUES_MAX))
+    return EINVAL;
+
+  if (__atomic_load_n(&ring->header->state, __ATOMIC_ACQUIRE) !=
+      LCC_SHM_STATE_OPEN)
+    return ESTALE;
+
+  /* Only this process writes "head". */
+  uint64_t head = __atomic_load_n(&ring->ctl->head, __ATOMIC_RELAXED);
+  uint64_t tail = __atomic_load_n(&ring->ctl->tail, __ATOMIC_ACQUIRE);
+  if (head - tail >= ring->ring_size) {
+    __atomic_add_fetch(&ring->ctl->dropped, 1, __ATOMIC_RELAXED);
+    return ENOBUFS;
+  }
+
+  size_t offset = (size_t)(head & (ring->ring_size - 1)) * ring->record_size;
+  lcc_shm_record_t *r = (lcc_shm_record_t *)(ring->records + offset);
+  ring_copy_name(r->host, vl->identifier.host);
+  ring_copy_name(r->plugin, vl->identifier.plugin);
+  ring_copy_name(r->plugin_instance, vl->identifier.plugin_instance);
+  ring_copy_name(r->type, vl->identifier.type);
+  ring_copy_name(r->type_instance, vl->identifier.type_instance);
+  r->time = vl->time;
+  r->interval = vl->interval;
+  r->values_num = (uint32_t)vl->values_len;
+  memcpy(r->values, vl->values, vl->values_len * sizeof(r->values[0]));
+
+  __atomic_store_n(&ring->ctl->head, head + 1, __ATOMIC_RELEASE);
+  return 0;
+} /* }}} int lcc_shm_ring_putval */
+#else  /* !HAVE_SHM_OPEN */
+int lcc_shm_open(__attribute__((unused)) const char *name,
+                 __attribute__((unused)) lcc_shm_t **ret_shm) {
+  return ENOTSUP;
+}
+
+void lcc_shm_close(__attribute__((unused)) lcc_shm_t *shm) {}
+
+int lcc_shm_getval(__attribute__((unused)) lcc_shm_t *shm,
+                   __attribute__((unused)) const lcc_identifier_t *ident,
+                   __attribute__((unused)) lcc_shm_value_t *ret_value) {
+  return ENOTSUP;
+}
+
+int lcc_shm_ring_open(__attribute__((unused)) const char *name,
+                      __attribute__((unused)) lcc_shm_ring_t **ret_ring) {
+  return ENOTSUP;
+}
+
+void lcc_shm_ring_close(__attribute__((unused)) lcc_shm_ring_t *ring) {}
+
+int lcc_shm_ring_putval(__attribute__((unused)) lcc_shm_ring_t *ring,
+                        __attribute__((unused)) const lcc_value_list_t *vl) {
+  return ENOTSUP;
+}
+#endif /* HAVE_SHM_OPEN */
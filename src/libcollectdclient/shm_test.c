@@ -0,0 +1,272 @@
+/**
+ * collectd - src/libcollectdclient/shm_test.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include "config.h"
+
+#include "collectd/shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "testing.h"
+
+#define TEST_SLOTS 4
+
+static char segment_name[64];
+
+/* Creates a segment with TEST_SLOTS empty slots, like the write_shm plugin
+ * does. */
+static lcc_shm_header_t *create_segment(void) {
+  snprintf(segment_name, sizeof(segment_name), "/collectd-test-%d",
+           (int)getpid());
+  shm_unlink(segment_name);
+
+  int fd = shm_open(segment_name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0)
+    return NULL;
+
+  size_t size = sizeof(lcc_shm_header_t) + TEST_SLOTS * sizeof(lcc_shm_slot_t);
+  void *addr = MAP_FAILED;
+  if (ftruncate(fd, (off_t)size) == 0)
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    return NULL;
+
+  lcc_shm_header_t *h = addr;
+  h->magic = LCC_SHM_MAGIC;
+  h->version = LCC_SHM_VERSION;
+  h->slots_num = TEST_SLOTS;
+  h->slot_size = sizeof(lcc_shm_slot_t);
+  h->state = LCC_SHM_STATE_OPEN;
+  return h;
+}
+
+static void destroy_segment(lcc_shm_header_t *h) {
+  munmap(h, sizeof(*h) + TEST_SLOTS * sizeof(lcc_shm_slot_t));
+  shm_unlink(segment_name);
+}
+
+/* Stores a gauge for "name" in the first free slot starting at "index", which
+ * lets the test force collisions. */
+static void put(lcc_shm_header_t *h, size_t index, char const *name,
+                double gauge) {
+  lcc_shm_slot_t *slots = (lcc_shm_slot_t *)(h + 1);
+
+  while (slots[index].hash != 0)
+    index = (index + 1) % TEST_SLOTS;
+
+  lcc_shm_slot_t *s = slots + index;
+  s->seq += 2;
+  s->hash = lcc_shm_hash(name);
+  s->time = 1500000000.0;
+  s->interval = 10.0;
+  s->values_num = 1;
+  s->values_types[0] = LCC_TYPE_GAUGE;
+  memcpy(&s->values[0], &gauge, sizeof(gauge));
+  s->rates[0] = gauge;
+  snprintf(s->values_names[0], sizeof(s->values_names[0]), "%s", "value");
+  snprintf(s->name, sizeof(s->name), "%s", name);
+}
+
+static size_t home_slot(char const *name) {
+  return (size_t)(lcc_shm_hash(name) % TEST_SLOTS);
+}
+
+DEF_TEST(getval) {
+  lcc_shm_header_t *h = create_segment();
+  CHECK_NOT_NULL(h);
+
+  lcc_identifier_t users = {"example.com", "users", "", "users", ""};
+  lcc_identifier_t missing = {"example.com", "cpu", "0", "cpu", "idle"};
+
+  /* Find a "load" identifier with the same home slot as "users", so that
+   * finding it needs probing. */
+  lcc_identifier_t load = {"example.com", "load", "", "load", ""};
+  char load_name[LCC_SHM_NAME_LEN];
+  for (int i = 0;; i++) {
+    snprintf(load.plugin_instance, sizeof(load.plugin_instance), "%d", i);
+    snprintf(load_name, sizeof(load_name), "example.com/load-%d/load", i);
+    if (home_slot(load_name) == home_slot("example.com/users/users"))
+      break;
+  }
+
+  put(h, home_slot("example.com/users/users"), "example.com/users/users", 3);
+  put(h, home_slot(load_name), load_name, 0.42);
+
+  lcc_shm_t *shm = NULL;
+  EXPECT_EQ_INT(0, lcc_shm_open(segment_name, &shm));
+  CHECK_NOT_NULL(shm);
+
+  lcc_shm_value_t v = {0};
+  EXPECT_EQ_INT(0, lcc_shm_getval(shm, &load, &v));
+  EXPECT_EQ_UINT64(1, v.values_num);
+  EXPECT_EQ_INT(LCC_TYPE_GAUGE, v.values_types[0]);
+  EXPECT_EQ_DOUBLE(0.42, v.values[0].gauge);
+  EXPECT_EQ_DOUBLE(0.42, v.rates[0]);
+  EXPECT_EQ_DOUBLE(10.0, v.interval);
+  EXPECT_EQ_STR("value", v.values_names[0]);
+
+  EXPECT_EQ_INT(0, lcc_shm_getval(shm, &users, &v));
+  EXPECT_EQ_DOUBLE(3, v.values[0].gauge);
+
+  EXPECT_EQ_INT(ENOENT, lcc_shm_getval(shm, &missing, &v));
+
+  /* A full table must not make the search loop forever. */
+  put(h, 0, "example.com/a/a", 1);
+  put(h, 0, "example.com/b/b", 2);
+  EXPECT_EQ_INT(ENOENT, lcc_shm_getval(shm, &missing, &v));
+
+  /* A slot that stays locked */
+  lcc_shm_slot_t *slots = (lcc_shm_slot_t *)(h + 1);
+  for (size_t i = 0; i < TEST_SLOTS; i++)
+    if (strcmp(slots[i].name, load_name) == 0)
+      slots[i].seq++;
+  EXPECT_EQ_INT(EAGAIN, lcc_shm_getval(shm, &load, &v));
+
+  h->state = LCC_SHM_STATE_CLOSED;
+  EXPECT_EQ_INT(ESTALE, lcc_shm_getval(shm, &users, &v));
+
+  lcc_shm_close(shm);
+  destroy_segment(h);
+  return 0;
+}
+
+DEF_TEST(open) {
+  lcc_shm_t *shm = NULL;
+  EXPECT_EQ_INT(ENOENT, lcc_shm_open("/collectd-test-does-not-exist", &shm));
+
+  lcc_shm_header_t *h = create_segment();
+  CHECK_NOT_NULL(h);
+
+  h->version = LCC_SHM_VERSION + 1;
+  EXPECT_EQ_INT(EPROTO, lcc_shm_open(segment_name, &shm));
+
+  /* more slots than the segment holds */
+  h->version = LCC_SHM_VERSION;
+  h->slots_num = TEST_SLOTS + 1;
+  EXPECT_EQ_INT(EPROTO, lcc_shm_open(segment_name, &shm));
+
+  destroy_segment(h);
+  return 0;
+}
+
+#define TEST_RINGS 2
+#define TEST_RING_SIZE 4
+
+DEF_TEST(ring) {
+  snprintf(segment_name, sizeof(segment_name), "/collectd-test-ring-%d",
+           (int)getpid());
+  shm_unlink(segment_name);
+
+  size_t size = sizeof(lcc_shm_ring_header_t) +
+                TEST_RINGS * (sizeof(lcc_shm_ring_ctl_t) +
+                              TEST_RING_SIZE * sizeof(lcc_shm_record_t));
+  int fd = shm_open(segment_name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  OK(fd >= 0);
+  CHECK_ZERO(ftruncate(fd, (off_t)size));
+  lcc_shm_ring_header_t *h =
+      mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  OK(h != MAP_FAILED);
+
+  h->magic = LCC_SHM_RING_MAGIC;
+  h->version = LCC_SHM_RING_VERSION;
+  h->rings_num = TEST_RINGS;
+  h->ring_size = TEST_RING_SIZE;
+  h->record_size = sizeof(lcc_shm_record_t);
+  h->state = LCC_SHM_STATE_OPEN;
+
+  lcc_shm_ring_ctl_t *ctls = (lcc_shm_ring_ctl_t *)(h + 1);
+  lcc_shm_record_t *records = (lcc_shm_record_t *)(ctls + TEST_RINGS);
+
+  lcc_shm_ring_t *r0 = NULL;
+  lcc_shm_ring_t *r1 = NULL;
+  lcc_shm_ring_t *r2 = NULL;
+  EXPECT_EQ_INT(0, lcc_shm_ring_open(segment_name, &r0));
+  EXPECT_EQ_INT(0, lcc_shm_ring_open(segment_name, &r1));
+  EXPECT_EQ_INT(EBUSY, lcc_shm_ring_open(segment_name, &r2));
+  EXPECT_EQ_INT((int)getpid(), (int)ctls[1].owner);
+
+  value_t values[] = {{.derive = 42}, {.derive = 23}};
+  lcc_value_list_t vl = {
+      .values = values,
+      .values_len = 2,
+      .time = 1500000000.0,
+      .identifier = {"example.com", "app", "", "if_octets", "eth0"},
+  };
+
+  /* the ring fills up */
+  for (int i = 0; i < TEST_RING_SIZE; i++)
+    EXPECT_EQ_INT(0, lcc_shm_ring_putval(r1, &vl));
+  EXPECT_EQ_INT(ENOBUFS, lcc_shm_ring_putval(r1, &vl));
+  EXPECT_EQ_UINT64(TEST_RING_SIZE, ctls[1].head);
+  EXPECT_EQ_UINT64(1, ctls[1].dropped);
+
+  lcc_shm_record_t *rec = records + TEST_RING_SIZE;
+  EXPECT_EQ_STR("example.com", rec->host);
+  EXPECT_EQ_STR("if_octets", rec->type);
+  EXPECT_EQ_STR("eth0", rec->type_instance);
+  EXPECT_EQ_UINT64(2, rec->values_num);
+  EXPECT_EQ_UINT64(23, rec->values[1]);
+  EXPECT_EQ_DOUBLE(1500000000.0, rec->time);
+
+  /* the daemon reads a record, making room for one more */
+  ctls[1].tail = 1;
+  EXPECT_EQ_INT(0, lcc_shm_ring_putval(r1, &vl));
+  EXPECT_EQ_INT(ENOBUFS, lcc_shm_ring_putval(r1, &vl));
+
+  lcc_value_list_t too_many = vl;
+  too_many.values_len = LCC_SHM_VALUES_MAX + 1;
+  EXPECT_EQ_INT(EINVAL, lcc_shm_ring_putval(r0, &too_many));
+
+  /* closing releases the ring */
+  lcc_shm_ring_close(r1);
+  EXPECT_EQ_INT(0, (int)ctls[1].owner);
+  EXPECT_EQ_INT(0, lcc_shm_ring_open(segment_name, &r2));
+  EXPECT_EQ_INT(ENOBUFS, lcc_shm_ring_putval(r2, &vl));
+
+  h->state = LCC_SHM_STATE_CLOSED;
+  EXPECT_EQ_INT(ESTALE, lcc_shm_ring_putval(r0, &vl));
+
+  lcc_shm_ring_close(r0);
+  lcc_shm_ring_close(r2);
+  munmap(h, size);
+  shm_unlink(segment_name);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(getval);
+  RUN_TEST(open);
+  RUN_TEST(ring);
+
+  END_TEST;
+}
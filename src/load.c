@@ -31,6 +31,12 @@
 #include "plugin.h"
 #include "utils/common/common.h"
 
+#if KERNEL_LINUX
+#include "utils/procfs/procfs.h"
+
+static cu_procfs_t *proc_loadavg;
+#endif
+
 #include <unistd.h>
 
 #ifdef HAVE_SYS_LOADAVG_H
@@ -110,51 +116,39 @@ static void load_submit(gauge_t snum, gauge_t mnum, gauge_t lnum) {
 }
 
 static int load_read(void) {
-#if defined(HAVE_GETLOADAVG)
-  double load[3];
-
-  if (getloadavg(load, 3) == 3)
-    load_submit(load[LOADAVG_1MIN], load[LOADAVG_5MIN], load[LOADAVG_15MIN]);
-  else {
-    WARNING("load: getloadavg failed: %s", STRERRNO);
-  }
-    /* #endif HAVE_GETLOADAVG */
-
-#elif defined(KERNEL_LINUX)
-  gauge_t snum, mnum, lnum;
-  FILE *loadavg;
-  char buffer[16];
-
-  char *fields[8];
-  int numfields;
-
-  if ((loadavg = fopen("/proc/loadavg", "r")) == NULL) {
-    WARNING("load: fopen: %s", STRERRNO);
+#if KERNEL_LINUX
+  /* Preferred over getloadavg(3), which opens /proc/loadavg on every call. */
+  if ((proc_loadavg == NULL) &&
+      ((proc_loadavg = cu_procfs_open("/proc/loadavg")) == NULL)) {
+    WARNING("load: open: %s", STRERRNO);
     return -1;
   }
 
-  if (fgets(buffer, 16, loadavg) == NULL) {
-    WARNING("load: fgets: %s", STRERRNO);
-    fclose(loadavg);
+  char *buffer = cu_procfs_read(proc_loadavg, NULL);
+  if (buffer == NULL) {
+    WARNING("load: read: %s", STRERRNO);
     return -1;
   }
 
-  if (fclose(loadavg)) {
-    WARNING("load: fclose: %s", STRERRNO);
-  }
-
-  numfields = strsplit(buffer, fields, 8);
+  char *fields[8];
+  int numfields = strsplit(buffer, fields, 8);
 
   if (numfields < 3)
     return -1;
 
-  snum = atof(fields[0]);
-  mnum = atof(fields[1]);
-  lnum = atof(fields[2]);
-
-  load_submit(snum, mnum, lnum);
+  load_submit(atof(fields[0]), atof(fields[1]), atof(fields[2]));
   /* #endif KERNEL_LINUX */
 
+#elif defined(HAVE_GETLOADAVG)
+  double load[3];
+
+  if (getloadavg(load, 3) == 3)
+    load_submit(load[LOADAVG_1MIN], load[LOADAVG_5MIN], load[LOADAVG_15MIN]);
+  else {
+    WARNING("load: getloadavg failed: %s", STRERRNO);
+  }
+    /* #endif HAVE_GETLOADAVG */
+
 #elif HAVE_LIBSTATGRAB
   gauge_t snum, mnum, lnum;
   sg_load_stats *ls;
@@ -191,7 +185,18 @@ static int load_read(void) {
   return 0;
 }
 
+#if KERNEL_LINUX
+static int load_shutdown(void) {
+  cu_procfs_close(proc_loadavg);
+  proc_loadavg = NULL;
+  return 0;
+}
+#endif
+
 void module_register(void) {
   plugin_register_config("load", load_config, config_keys, config_keys_num);
   plugin_register_read("load", load_read);
+#if KERNEL_LINUX
+  plugin_register_shutdown("load", load_shutdown);
+#endif
 } /* void module_register */
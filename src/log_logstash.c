@@ -30,6 +30,7 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/log_writer/log_writer.h"
 
 #include <sys/types.h>
 #include <yajl/yajl_common.h>
@@ -51,7 +52,12 @@ static pthread_mutex_t file_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static char *log_file;
 
-static const char *config_keys[] = {"LogLevel", "File"};
+/* Set in the init callback if "Async" is enabled. */
+static bool log_async;
+static size_t log_queue_size = 4096;
+static c_log_writer_t *log_writer;
+
+static const char *config_keys[] = {"LogLevel", "File", "Async", "QueueSize"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static int log_logstash_config(const char *key, const char *value) {
@@ -66,6 +72,15 @@ static int log_logstash_config(const char *key, const char *value) {
   } else if (0 == strcasecmp(key, "File")) {
     sfree(log_file);
     log_file = strdup(value);
+  } else if (0 == strcasecmp(key, "Async")) {
+    log_async = IS_TRUE(value);
+  } else if (0 == strcasecmp(key, "QueueSize")) {
+    int size = atoi(value);
+    if (size < 1) {
+      ERROR("log_logstash: invalid QueueSize [%s]", value);
+      return 1;
+    }
+    log_queue_size = (size_t)size;
   } else {
     return -1;
   }
@@ -144,6 +159,17 @@ static void log_logstash_print(yajl_gen g, int severity,
 
   if (yajl_gen_get_buf(g, &buf, &len) != yajl_gen_status_ok)
     goto err;
+
+  c_log_writer_t *w = __atomic_load_n(&log_writer, __ATOMIC_ACQUIRE);
+  if (w != NULL) {
+    char line[len + 1];
+    memcpy(line, buf, len);
+    line[len] = '\n';
+    c_log_writer_write(w, line, sizeof(line));
+    yajl_gen_free(g);
+    return;
+  }
+
   pthread_mutex_lock(&file_lock);
 
   if (log_file == NULL) {
@@ -322,11 +348,39 @@ err:
   return 0;
 } /* int log_logstash_notification */
 
+static int log_logstash_init(void) {
+  if (!log_async || (log_writer != NULL))
+    return 0;
+
+  c_log_writer_t *w =
+      c_log_writer_create("log_logstash", log_file, log_queue_size);
+  if (w == NULL) {
+    ERROR("log_logstash: Starting the log writer failed. Writing messages "
+          "synchronously.");
+    return 0;
+  }
+
+  __atomic_store_n(&log_writer, w, __ATOMIC_RELEASE);
+  return 0;
+} /* int log_logstash_init */
+
+/* Called when the log callback is unregistered, i.e. after all other
+ * callbacks, so that messages logged during shutdown are still written. */
+static void log_logstash_writer_free(void *arg) {
+  c_log_writer_t **w = arg;
+  c_log_writer_t *tmp = __atomic_exchange_n(w, NULL, __ATOMIC_ACQ_REL);
+  c_log_writer_destroy(tmp);
+} /* void log_logstash_writer_free */
+
 void module_register(void) {
   plugin_register_config("log_logstash", log_logstash_config, config_keys,
                          config_keys_num);
+  plugin_register_init("log_logstash", log_logstash_init);
   plugin_register_log("log_logstash", log_logstash_log,
-                      /* user_data = */ NULL);
+                      &(user_data_t){
+                          .data = &log_writer,
+                          .free_func = log_logstash_writer_free,
+                      });
   plugin_register_notification("log_logstash", log_logstash_notification,
                                /* user_data = */ NULL);
 } /* void module_register (void) */
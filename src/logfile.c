@@ -30,6 +30,7 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/log_writer/log_writer.h"
 
 #if COLLECT_DEBUG
 static int log_level = LOG_DEBUG;
@@ -43,8 +44,13 @@ static char *log_file;
 static int print_timestamp = 1;
 static int print_severity;
 
+/* Set in the init callback if "Async" is enabled. */
+static bool log_async;
+static size_t log_queue_size = 4096;
+static c_log_writer_t *log_writer;
+
 static const char *config_keys[] = {"LogLevel", "File", "Timestamp",
-                                    "PrintSeverity"};
+                                    "PrintSeverity", "Async", "QueueSize"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static int logfile_config(const char *key, const char *value) {
@@ -68,6 +74,16 @@ static int logfile_config(const char *key, const char *value) {
       print_severity = 0;
     else
       print_severity = 1;
+  } else if (0 == strcasecmp(key, "Async")) {
+    log_async = IS_TRUE(value);
+  } else if (0 == strcasecmp(key, "QueueSize")) {
+    int size = atoi(value);
+    if (size < 1) {
+      WARNING("logfile: invalid QueueSize [%s], keeping %" PRIsz, value,
+              log_queue_size);
+      return 0;
+    }
+    log_queue_size = (size_t)size;
   } else {
     return -1;
   }
@@ -112,6 +128,26 @@ static void logfile_print(const char *msg, int severity,
     timestamp_str[sizeof(timestamp_str) - 1] = '\0';
   }
 
+  c_log_writer_t *w = __atomic_load_n(&log_writer, __ATOMIC_ACQUIRE);
+  if (w != NULL) {
+    char line[1280];
+    int len;
+    if (print_timestamp)
+      len = snprintf(line, sizeof(line), "[%s] %s%s\n", timestamp_str,
+                     level_str, msg);
+    else
+      len = snprintf(line, sizeof(line), "%s%s\n", level_str, msg);
+    if (len < 0)
+      return;
+    if ((size_t)len >= sizeof(line)) {
+      len = sizeof(line) - 1;
+      line[len - 1] = '\n';
+    }
+
+    c_log_writer_write(w, line, (size_t)len);
+    return;
+  }
+
   pthread_mutex_lock(&file_lock);
 
   if (log_file == NULL) {
@@ -196,10 +232,38 @@ static int logfile_notification(const notification_t *n,
   return 0;
 } /* int logfile_notification */
 
+static int logfile_init(void) {
+  if (!log_async || (log_writer != NULL))
+    return 0;
+
+  c_log_writer_t *w = c_log_writer_create("logfile", log_file, log_queue_size);
+  if (w == NULL) {
+    ERROR("logfile: Starting the log writer failed. Writing messages "
+          "synchronously.");
+    return 0;
+  }
+
+  __atomic_store_n(&log_writer, w, __ATOMIC_RELEASE);
+  return 0;
+} /* int logfile_init */
+
+/* Called when the log callback is unregistered, i.e. after all other
+ * callbacks, so that messages logged during shutdown are still written. */
+static void logfile_writer_free(void *arg) {
+  c_log_writer_t **w = arg;
+  c_log_writer_t *tmp = __atomic_exchange_n(w, NULL, __ATOMIC_ACQ_REL);
+  c_log_writer_destroy(tmp);
+} /* void logfile_writer_free */
+
 void module_register(void) {
   plugin_register_config("logfile", logfile_config, config_keys,
                          config_keys_num);
-  plugin_register_log("logfile", logfile_log, /* user_data = */ NULL);
+  plugin_register_init("logfile", logfile_init);
+  plugin_register_log("logfile", logfile_log,
+                      &(user_data_t){
+                          .data = &log_writer,
+                          .free_func = logfile_writer_free,
+                      });
   plugin_register_notification("logfile", logfile_notification,
                                /* user_data = */ NULL);
 } /* void module_register (void) */
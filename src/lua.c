@@ -31,6 +31,7 @@
 #include "collectd.h"
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils_complain.h"
 #include "utils_lua.h"
 
 /* Include the Lua API header files. */
@@ -40,35 +41,95 @@
 
 #include <pthread.h>
 
+#if LUA_VERSION_NUM < 502
+#define lua_rawlen lua_objlen
+#endif
+
 #define PLUGIN_READ 1
 #define PLUGIN_WRITE 2
+#define PLUGIN_WRITE_BATCH 3
 
 typedef struct lua_script_s {
-  lua_State *lua_state;
+  /* Independent states which all ran the script. A state is used by one
+   * callback at a time; only scripts that declared themselves stateless get
+   * more than one, see "StatePoolSize". */
+  lua_State **states;
+  size_t states_num;
+  size_t *free_states;
+  size_t free_states_num;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+
+  bool stateless;
+  /* Number of callbacks registered by states[0]. */
+  int callbacks_num;
+
   struct lua_script_s *next;
 } lua_script_t;
 
+/* A value list queued for a batch writer. Only "vl.values" is copied. */
 typedef struct {
-  lua_State *lua_state;
+  const data_set_t *ds;
+  value_list_t vl;
+} clua_write_item_t;
+
+typedef struct clua_callback_data_s {
+  lua_script_t *script;
   char *lua_function_name;
-  pthread_mutex_t lock;
+  /* Index of the function in the "collectd:callbacks" table of each of the
+   * script's states. */
   int callback_id;
+
+  /* Writers registered with collectd.register_write_batch(). The write
+   * callback only copies the value list into a bounded queue; the writer's
+   * own thread passes up to "batch_size" value lists to the Lua function in a
+   * single call. */
+  pthread_t thread;
+  bool thread_running;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  clua_write_item_t *queue;
+  size_t queue_limit;
+  size_t queue_head;
+  size_t queue_len;
+  size_t batch_size;
+  bool shutdown;
+  uint64_t dropped;
+  c_complain_t complaint;
+  struct clua_callback_data_s *next_batch;
 } clua_callback_data_t;
 
 static char base_path[PATH_MAX];
+static size_t state_pool_size = 1;
 static lua_script_t *scripts;
 
+/* all batch writers, stopped by lua_shutdown() before the scripts are freed */
+static clua_callback_data_t *batch_writers;
+static pthread_mutex_t batch_writers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Appends the function at `idx' to the state's "collectd:callbacks" table and
+ * returns its index in that table. */
 static int clua_store_callback(lua_State *L, int idx) /* {{{ */
 {
+  if (idx < 1)
+    idx += lua_gettop(L) + 1;
+
+  lua_getfield(L, LUA_REGISTRYINDEX, "collectd:callbacks");
+  int callback_id = (int)lua_rawlen(L, -1) + 1;
+
   /* Copy the function pointer */
   lua_pushvalue(L, idx);
+  lua_rawseti(L, -2, callback_id);
+  lua_pop(L, 1);
 
-  return luaL_ref(L, LUA_REGISTRYINDEX);
+  return callback_id;
 } /* }}} int clua_store_callback */
 
-static int clua_load_callback(lua_State *L, int callback_ref) /* {{{ */
+static int clua_load_callback(lua_State *L, int callback_id) /* {{{ */
 {
-  lua_rawgeti(L, LUA_REGISTRYINDEX, callback_ref);
+  lua_getfield(L, LUA_REGISTRYINDEX, "collectd:callbacks");
+  lua_rawgeti(L, -1, callback_id);
+  lua_remove(L, -2);
 
   if (!lua_isfunction(L, -1)) {
     lua_pop(L, 1);
@@ -78,64 +139,115 @@ static int clua_load_callback(lua_State *L, int callback_ref) /* {{{ */
   return 0;
 } /* }}} int clua_load_callback */
 
-/* Store the threads in a global variable so they are not cleaned up by the
- * garbage collector. */
-static int clua_store_thread(lua_State *L, int idx) /* {{{ */
+static lua_script_t *clua_get_script(lua_State *L) /* {{{ */
 {
-  if (!lua_isthread(L, idx)) {
-    return -1;
-  }
-
-  /* Copy the thread pointer */
-  lua_pushvalue(L, idx);
+  lua_getfield(L, LUA_REGISTRYINDEX, "collectd:script");
+  lua_script_t *script = lua_touserdata(L, -1);
+  lua_pop(L, 1);
 
-  luaL_ref(L, LUA_REGISTRYINDEX);
-  return 0;
-} /* }}} int clua_store_thread */
+  return script;
+} /* }}} lua_script_t *clua_get_script */
 
-static int clua_read(user_data_t *ud) /* {{{ */
-{
-  clua_callback_data_t *cb = ud->data;
+/* Waits for one of the script's states to become available. */
+static lua_State *clua_state_acquire(lua_script_t *script, /* {{{ */
+                                     size_t *ret_index) {
+  pthread_mutex_lock(&script->lock);
+  while (script->free_states_num == 0)
+    pthread_cond_wait(&script->cond, &script->lock);
 
-  pthread_mutex_lock(&cb->lock);
+  size_t index = script->free_states[--script->free_states_num];
+  pthread_mutex_unlock(&script->lock);
 
-  lua_State *L = cb->lua_state;
+  *ret_index = index;
+  return script->states[index];
+} /* }}} lua_State *clua_state_acquire */
 
-  int status = clua_load_callback(L, cb->callback_id);
-  if (status != 0) {
-    ERROR("Lua plugin: Unable to load callback \"%s\" (id %i).",
-          cb->lua_function_name, cb->callback_id);
-    pthread_mutex_unlock(&cb->lock);
-    return -1;
+static void clua_state_release(lua_script_t *script, size_t index) /* {{{ */
+{
+  pthread_mutex_lock(&script->lock);
+  script->free_states[script->free_states_num++] = index;
+  pthread_cond_signal(&script->cond);
+  pthread_mutex_unlock(&script->lock);
+} /* }}} void clua_state_release */
+
+/* Pushes a table describing the value list, or nothing if that fails.
+ * Stateless scripts must not keep references to the arguments of their
+ * callbacks, so their tables are reused: the "collectd:tables" table of the
+ * state holds one table per position in a batch. */
+static int clua_push_valuelist(lua_script_t *script, lua_State *L, /* {{{ */
+                               lua_Integer position, const data_set_t *ds,
+                               const value_list_t *vl) {
+  if (!script->stateless)
+    return luaC_pushvaluelist(L, ds, vl);
+
+  lua_getfield(L, LUA_REGISTRYINDEX, "collectd:tables");
+  lua_rawgeti(L, -1, position);
+  if (!lua_istable(L, -1)) {
+    lua_pop(L, 1);
+    lua_newtable(L);
+    lua_pushvalue(L, -1);
+    lua_rawseti(L, -3, position);
   }
-  /* +1 = 1 */
+  lua_remove(L, -2);
 
-  status = lua_pcall(L, 0, 1, 0);
+  int status = luaC_setvaluelist(L, -1, ds, vl);
+  if (status != 0)
+    lua_pop(L, 1);
+  return status;
+} /* }}} int clua_push_valuelist */
+
+/* Calls the function below the `nargs' arguments on top of the stack and
+ * returns the numeric status it returned. The function and arguments are
+ * removed from the stack. */
+static int clua_call(lua_State *L, clua_callback_data_t *cb, /* {{{ */
+                     int nargs, const char *kind) {
+  int status = lua_pcall(L, nargs, 1, 0);
   if (status != 0) {
     const char *errmsg = lua_tostring(L, -1);
     if (errmsg == NULL)
-      ERROR("Lua plugin: Calling a read callback failed. "
-            "In addition, retrieving the error message failed.");
+      ERROR("Lua plugin: Calling the %s callback \"%s\" failed. "
+            "In addition, retrieving the error message failed.",
+            kind, cb->lua_function_name);
     else
-      ERROR("Lua plugin: Calling a read callback failed: %s", errmsg);
+      ERROR("Lua plugin: Calling the %s callback \"%s\" failed:\n%s", kind,
+            cb->lua_function_name, errmsg);
     lua_pop(L, 1);
-    pthread_mutex_unlock(&cb->lock);
     return -1;
   }
 
   if (!lua_isnumber(L, -1)) {
-    ERROR("Lua plugin: Read function \"%s\" (id %i) did not return a numeric "
-          "status.",
-          cb->lua_function_name, cb->callback_id);
+    ERROR("Lua plugin: The %s function \"%s\" (id %i) did not return a "
+          "numeric status.",
+          kind, cb->lua_function_name, cb->callback_id);
     status = -1;
   } else {
     status = (int)lua_tointeger(L, -1);
   }
 
-  /* pop return value and function */
-  lua_pop(L, 1); /* -1 = 0 */
+  /* pop return value */
+  lua_pop(L, 1);
+  return status;
+} /* }}} int clua_call */
 
-  pthread_mutex_unlock(&cb->lock);
+static int clua_read(user_data_t *ud) /* {{{ */
+{
+  clua_callback_data_t *cb = ud->data;
+
+  size_t state_index;
+  lua_State *L = clua_state_acquire(cb->script, &state_index);
+
+  int status = clua_load_callback(L, cb->callback_id);
+  if (status != 0) {
+    ERROR("Lua plugin: Unable to load callback \"%s\" (id %i).",
+          cb->lua_function_name, cb->callback_id);
+    clua_state_release(cb->script, state_index);
+    return -1;
+  }
+  /* +1 = 1 */
+
+  status = clua_call(L, cb, 0, "read"); /* -1 = 0 */
+
+  clua_state_release(cb->script, state_index);
   return status;
 } /* }}} int clua_read */
 
@@ -143,54 +255,164 @@ static int clua_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
                       user_data_t *ud) {
   clua_callback_data_t *cb = ud->data;
 
-  pthread_mutex_lock(&cb->lock);
-
-  lua_State *L = cb->lua_state;
+  size_t state_index;
+  lua_State *L = clua_state_acquire(cb->script, &state_index);
 
   int status = clua_load_callback(L, cb->callback_id);
   if (status != 0) {
     ERROR("Lua plugin: Unable to load callback \"%s\" (id %i).",
           cb->lua_function_name, cb->callback_id);
-    pthread_mutex_unlock(&cb->lock);
+    clua_state_release(cb->script, state_index);
     return -1;
   }
   /* +1 = 1 */
 
-  status = luaC_pushvaluelist(L, ds, vl);
+  status = clua_push_valuelist(cb->script, L, 1, ds, vl);
   if (status != 0) {
     lua_pop(L, 1); /* -1 = 0 */
-    pthread_mutex_unlock(&cb->lock);
+    clua_state_release(cb->script, state_index);
     ERROR("Lua plugin: luaC_pushvaluelist failed.");
     return -1;
   }
   /* +1 = 2 */
 
-  status = lua_pcall(L, 1, 1, 0); /* -2+1 = 1 */
-  if (status != 0) {
-    const char *errmsg = lua_tostring(L, -1);
-    if (errmsg == NULL)
-      ERROR("Lua plugin: Calling the write callback failed. "
-            "In addition, retrieving the error message failed.");
-    else
-      ERROR("Lua plugin: Calling the write callback failed:\n%s", errmsg);
-    lua_pop(L, 1); /* -1 = 0 */
-    pthread_mutex_unlock(&cb->lock);
-    return -1;
-  }
+  status = clua_call(L, cb, 1, "write"); /* -2 = 0 */
 
-  if (!lua_isnumber(L, -1)) {
-    ERROR("Lua plugin: Write function \"%s\" (id %i) did not return a numeric "
-          "value.",
+  clua_state_release(cb->script, state_index);
+  return status;
+} /* }}} int clua_write */
+
+/* Calls the batch writer's function with an array of value list tables. */
+static void clua_write_batch_deliver(clua_callback_data_t *cb, /* {{{ */
+                                     clua_write_item_t *items, size_t num) {
+  lua_script_t *script = cb->script;
+
+  size_t state_index;
+  lua_State *L = clua_state_acquire(script, &state_index);
+
+  if (clua_load_callback(L, cb->callback_id) != 0) {
+    ERROR("Lua plugin: Unable to load callback \"%s\" (id %i).",
           cb->lua_function_name, cb->callback_id);
-    status = -1;
+    clua_state_release(script, state_index);
+    return;
+  }
+  /* +1 = 1 */
+
+  size_t old_len = 0;
+  if (script->stateless) {
+    lua_getfield(L, LUA_REGISTRYINDEX, "collectd:batch");
+    old_len = lua_rawlen(L, -1);
   } else {
-    status = (int)lua_tointeger(L, -1);
+    lua_createtable(L, (int)num, 0);
+  }
+  /* +1 = 2 */
+
+  lua_Integer n = 0;
+  for (size_t i = 0; i < num; i++) {
+    if (clua_push_valuelist(script, L, n + 1, items[i].ds, &items[i].vl) != 0)
+      continue;
+    lua_rawseti(L, -2, ++n);
+  }
+  for (size_t i = (size_t)n + 1; i <= old_len; i++) {
+    lua_pushnil(L);
+    lua_rawseti(L, -2, (lua_Integer)i);
+  }
+
+  clua_call(L, cb, 1, "write"); /* -2 = 0 */
+
+  clua_state_release(script, state_index);
+} /* }}} void clua_write_batch_deliver */
+
+static void *clua_write_batch_thread(void *arg) /* {{{ */
+{
+  clua_callback_data_t *cb = arg;
+
+  clua_write_item_t *batch = calloc(cb->batch_size, sizeof(*batch));
+  if (batch == NULL) {
+    ERROR("Lua plugin: clua_write_batch_thread: calloc failed.");
+    return NULL;
   }
 
-  lua_pop(L, 1); /* -1 = 0 */
+  pthread_mutex_lock(&cb->lock);
+  while (true) {
+    while (!cb->shutdown && (cb->queue_len == 0))
+      pthread_cond_wait(&cb->cond, &cb->lock);
+    if (cb->queue_len == 0)
+      break;
+
+    size_t num = cb->queue_len;
+    if (num > cb->batch_size)
+      num = cb->batch_size;
+    for (size_t i = 0; i < num; i++)
+      batch[i] = cb->queue[(cb->queue_head + i) % cb->queue_limit];
+    cb->queue_head = (cb->queue_head + num) % cb->queue_limit;
+    cb->queue_len -= num;
+    pthread_mutex_unlock(&cb->lock);
+
+    clua_write_batch_deliver(cb, batch, num);
+
+    for (size_t i = 0; i < num; i++)
+      sfree(batch[i].vl.values);
+
+    pthread_mutex_lock(&cb->lock);
+  }
   pthread_mutex_unlock(&cb->lock);
-  return status;
-} /* }}} int clua_write */
+
+  sfree(batch);
+  return NULL;
+} /* }}} void *clua_write_batch_thread */
+
+static int clua_write_batch(const data_set_t *ds, /* {{{ */
+                            const value_list_t *vl, user_data_t *ud) {
+  clua_callback_data_t *cb = ud->data;
+
+  /* clua_push_valuelist() ignores meta data, so only the values are copied,
+   * outside of cb->lock. */
+  clua_write_item_t item = {.ds = ds, .vl = *vl};
+  item.vl.meta = NULL;
+  item.vl.values = malloc(vl->values_len * sizeof(*vl->values));
+  if (item.vl.values == NULL) {
+    ERROR("Lua plugin: clua_write_batch: malloc failed.");
+    return ENOMEM;
+  }
+  memcpy(item.vl.values, vl->values, vl->values_len * sizeof(*vl->values));
+
+  pthread_mutex_lock(&cb->lock);
+  if (cb->queue_len >= cb->queue_limit) {
+    cb->dropped++;
+    pthread_mutex_unlock(&cb->lock);
+    c_complain(LOG_WARNING, &cb->complaint,
+               "Lua plugin: The queue of batch writer \"%s\" is full, "
+               "dropping values.",
+               cb->lua_function_name);
+    sfree(item.vl.values);
+    return ENOBUFS;
+  }
+  cb->queue[(cb->queue_head + cb->queue_len) % cb->queue_limit] = item;
+  cb->queue_len++;
+  pthread_cond_signal(&cb->cond);
+  pthread_mutex_unlock(&cb->lock);
+
+  c_release(LOG_INFO, &cb->complaint,
+            "Lua plugin: The queue of batch writer \"%s\" accepts values "
+            "again.",
+            cb->lua_function_name);
+  return 0;
+} /* }}} int clua_write_batch */
+
+/* Delivers the values queued by a batch writer and stops its thread. */
+static void clua_write_batch_stop(clua_callback_data_t *cb) /* {{{ */
+{
+  pthread_mutex_lock(&cb->lock);
+  cb->shutdown = true;
+  pthread_cond_signal(&cb->cond);
+  pthread_mutex_unlock(&cb->lock);
+
+  if (cb->thread_running) {
+    pthread_join(cb->thread, NULL);
+    cb->thread_running = false;
+  }
+} /* }}} void clua_write_batch_stop */
 
 /*
  * Exported functions
@@ -263,8 +485,33 @@ static int lua_cb_dispatch_values(lua_State *L) /* {{{ */
 
 static void lua_cb_free(void *data) {
   clua_callback_data_t *cb = data;
+
+  if (cb->queue != NULL) {
+    pthread_mutex_lock(&batch_writers_lock);
+    for (clua_callback_data_t **p = &batch_writers; *p != NULL;
+         p = &(*p)->next_batch) {
+      if (*p == cb) {
+        *p = cb->next_batch;
+        break;
+      }
+    }
+    pthread_mutex_unlock(&batch_writers_lock);
+
+    clua_write_batch_stop(cb);
+
+    for (size_t i = 0; i < cb->queue_len; i++)
+      sfree(cb->queue[(cb->queue_head + i) % cb->queue_limit].vl.values);
+    sfree(cb->queue);
+    pthread_mutex_destroy(&cb->lock);
+    pthread_cond_destroy(&cb->cond);
+
+    if (cb->dropped > 0)
+      WARNING("Lua plugin: Batch writer \"%s\" dropped %" PRIu64 " value "
+              "lists because its queue was full.",
+              cb->lua_function_name, cb->dropped);
+  }
+
   free(cb->lua_function_name);
-  pthread_mutex_destroy(&cb->lock);
   free(cb);
 }
 
@@ -272,8 +519,24 @@ static int lua_cb_register_generic(lua_State *L, int type) /* {{{ */
 {
   int nargs = lua_gettop(L);
 
-  if (nargs != 1)
+  lua_Integer batch_size = 1024;
+  lua_Integer queue_limit = 65536;
+  if (PLUGIN_WRITE_BATCH == type) {
+    if ((nargs < 1) || (nargs > 3))
+      return luaL_error(L, "Invalid number of arguments (%d not in [1, 3])",
+                        nargs);
+    batch_size = luaL_optinteger(L, 2, batch_size);
+    queue_limit = luaL_optinteger(L, 3, queue_limit);
+    if ((batch_size < 1) || (queue_limit < 1))
+      return luaL_error(L, "%s", "batch_size and queue_limit must be positive");
+    lua_settop(L, 1);
+  } else if (nargs != 1) {
     return luaL_error(L, "Invalid number of arguments (%d != 1)", nargs);
+  }
+
+  lua_script_t *script = clua_get_script(L);
+  if (script == NULL)
+    return luaL_error(L, "%s", "Unable to find the script's state");
 
   char subname[DATA_MAX_NAME_LEN];
   if (!lua_isfunction(L, 1) && lua_isstring(L, 1)) {
@@ -303,23 +566,28 @@ static int lua_cb_register_generic(lua_State *L, int type) /* {{{ */
   lua_pop(L, 1);
 
   int callback_id = clua_store_callback(L, 1);
-  if (callback_id < 0)
-    return luaL_error(L, "%s", "Storing callback function failed");
 
-  lua_State *thread = lua_newthread(L);
-  if (thread == NULL)
-    return luaL_error(L, "%s", "lua_newthread failed");
-  clua_store_thread(L, -1);
+  /* Additional states of a stateless script only store their functions; the
+   * plugin callbacks were registered by the first state. */
+  lua_getfield(L, LUA_REGISTRYINDEX, "collectd:replica");
+  bool replica = lua_toboolean(L, -1);
   lua_pop(L, 1);
+  if (replica) {
+    if (callback_id > script->callbacks_num)
+      return luaL_error(L, "%s",
+                        "The script registered more callbacks than when it "
+                        "was loaded first");
+    return 0;
+  }
+  script->callbacks_num = callback_id;
 
   clua_callback_data_t *cb = calloc(1, sizeof(*cb));
   if (cb == NULL)
     return luaL_error(L, "%s", "calloc failed");
 
-  cb->lua_state = thread;
+  cb->script = script;
   cb->callback_id = callback_id;
   cb->lua_function_name = strdup(function_name);
-  pthread_mutex_init(&cb->lock, NULL);
 
   if (PLUGIN_READ == type) {
     int status = plugin_register_complex_read(/* group = */ "lua",
@@ -342,10 +610,46 @@ static int lua_cb_register_generic(lua_State *L, int type) /* {{{ */
                                            .free_func = lua_cb_free,
                                        });
 
+    if (status != 0)
+      return luaL_error(L, "%s", "plugin_register_write failed");
+    return 0;
+  } else if (PLUGIN_WRITE_BATCH == type) {
+    cb->batch_size = (size_t)batch_size;
+    cb->queue_limit = (size_t)queue_limit;
+    cb->queue = calloc(cb->queue_limit, sizeof(*cb->queue));
+    if (cb->queue == NULL) {
+      lua_cb_free(cb);
+      return luaL_error(L, "%s", "calloc failed");
+    }
+    pthread_mutex_init(&cb->lock, NULL);
+    pthread_cond_init(&cb->cond, NULL);
+    C_COMPLAIN_INIT(&cb->complaint);
+
+    int status = plugin_thread_create(&cb->thread, clua_write_batch_thread, cb,
+                                      "lua write batch");
+    if (status != 0) {
+      lua_cb_free(cb);
+      return luaL_error(L, "%s", "Starting the batch writer thread failed");
+    }
+    cb->thread_running = true;
+
+    pthread_mutex_lock(&batch_writers_lock);
+    cb->next_batch = batch_writers;
+    batch_writers = cb;
+    pthread_mutex_unlock(&batch_writers_lock);
+
+    status = plugin_register_write(/* name = */ function_name,
+                                   /* callback  = */ clua_write_batch,
+                                   &(user_data_t){
+                                       .data = cb,
+                                       .free_func = lua_cb_free,
+                                   });
+
     if (status != 0)
       return luaL_error(L, "%s", "plugin_register_write failed");
     return 0;
   } else {
+    lua_cb_free(cb);
     return luaL_error(L, "%s", "lua_cb_register_generic unsupported type");
   }
 } /* }}} int lua_cb_register_generic */
@@ -358,6 +662,20 @@ static int lua_cb_register_write(lua_State *L) {
   return lua_cb_register_generic(L, PLUGIN_WRITE);
 }
 
+static int lua_cb_register_write_batch(lua_State *L) {
+  return lua_cb_register_generic(L, PLUGIN_WRITE_BATCH);
+}
+
+static int lua_cb_declare_stateless(lua_State *L) /* {{{ */
+{
+  lua_script_t *script = clua_get_script(L);
+  if (script == NULL)
+    return luaL_error(L, "%s", "Unable to find the script's state");
+
+  script->stateless = true;
+  return 0;
+} /* }}} int lua_cb_declare_stateless */
+
 static const luaL_Reg collectdlib[] = {
     {"log_debug", lua_cb_log_debug},
     {"log_error", lua_cb_log_error},
@@ -367,6 +685,8 @@ static const luaL_Reg collectdlib[] = {
     {"dispatch_values", lua_cb_dispatch_values},
     {"register_read", lua_cb_register_read},
     {"register_write", lua_cb_register_write},
+    {"register_write_batch", lua_cb_register_write_batch},
+    {"declare_stateless", lua_cb_declare_stateless},
     {NULL, NULL}};
 
 static int open_collectd(lua_State *L) /* {{{ */
@@ -386,94 +706,100 @@ static void lua_script_free(lua_script_t *script) /* {{{ */
 
   lua_script_t *next = script->next;
 
-  if (script->lua_state != NULL) {
-    lua_close(script->lua_state);
-    script->lua_state = NULL;
-  }
+  for (size_t i = 0; i < script->states_num; i++)
+    lua_close(script->states[i]);
+  sfree(script->states);
+  sfree(script->free_states);
+  pthread_mutex_destroy(&script->lock);
+  pthread_cond_destroy(&script->cond);
 
   sfree(script);
 
   lua_script_free(next);
 } /* }}} void lua_script_free */
 
-static int lua_script_init(lua_script_t *script) /* {{{ */
-{
-  memset(script, 0, sizeof(*script));
-
+static lua_State *lua_state_create(lua_script_t *script, /* {{{ */
+                                   const char *script_path, bool replica) {
   /* initialize the lua context */
-  script->lua_state = luaL_newstate();
-  if (script->lua_state == NULL) {
+  lua_State *L = luaL_newstate();
+  if (L == NULL) {
     ERROR("Lua plugin: luaL_newstate() failed.");
-    return -1;
+    return NULL;
   }
 
   /* Open up all the standard Lua libraries. */
-  luaL_openlibs(script->lua_state);
+  luaL_openlibs(L);
 
 /* Load the 'collectd' library */
 #if LUA_VERSION_NUM < 502
-  lua_pushcfunction(script->lua_state, open_collectd);
-  lua_pushstring(script->lua_state, "collectd");
-  lua_call(script->lua_state, 1, 0);
+  lua_pushcfunction(L, open_collectd);
+  lua_pushstring(L, "collectd");
+  lua_call(L, 1, 0);
 #else
-  luaL_requiref(script->lua_state, "collectd", open_collectd, 1);
-  lua_pop(script->lua_state, 1);
+  luaL_requiref(L, "collectd", open_collectd, 1);
+  lua_pop(L, 1);
 #endif
 
   /* Prepend BasePath to package.path */
   if (base_path[0] != '\0') {
-    lua_getglobal(script->lua_state, "package");
-    lua_getfield(script->lua_state, -1, "path");
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "path");
 
-    const char *cur_path = lua_tostring(script->lua_state, -1);
+    const char *cur_path = lua_tostring(L, -1);
     char *new_path = ssnprintf_alloc("%s/?.lua;%s", base_path, cur_path);
 
-    lua_pop(script->lua_state, 1);
-    lua_pushstring(script->lua_state, new_path);
+    lua_pop(L, 1);
+    lua_pushstring(L, new_path);
 
     free(new_path);
 
-    lua_setfield(script->lua_state, -2, "path");
-    lua_pop(script->lua_state, 1);
+    lua_setfield(L, -2, "path");
+    lua_pop(L, 1);
   }
 
-  return 0;
-} /* }}} int lua_script_init */
-
-static int lua_script_load(const char *script_path) /* {{{ */
+  lua_pushlightuserdata(L, script);
+  lua_setfield(L, LUA_REGISTRYINDEX, "collectd:script");
+  lua_pushboolean(L, replica);
+  lua_setfield(L, LUA_REGISTRYINDEX, "collectd:replica");
+  lua_pushstring(L, script_path);
+  lua_setfield(L, LUA_REGISTRYINDEX, "collectd:script_path");
+  lua_pushinteger(L, 0);
+  lua_setfield(L, LUA_REGISTRYINDEX, "collectd:callback_num");
+  lua_newtable(L);
+  lua_setfield(L, LUA_REGISTRYINDEX, "collectd:callbacks");
+  lua_newtable(L);
+  lua_setfield(L, LUA_REGISTRYINDEX, "collectd:tables");
+  lua_newtable(L);
+  lua_setfield(L, LUA_REGISTRYINDEX, "collectd:batch");
+
+  return L;
+} /* }}} lua_State *lua_state_create */
+
+/* Runs the script in a new state. Returns non-zero if running the script
+ * failed; `*ret_state' is set anyway if the state has to be kept because it
+ * may have registered callbacks. */
+static int lua_state_load(lua_script_t *script, const char *script_path,
+                          bool replica, lua_State **ret_state) /* {{{ */
 {
-  lua_script_t *script = malloc(sizeof(*script));
-  if (script == NULL) {
-    ERROR("Lua plugin: malloc failed.");
-    return -1;
-  }
+  *ret_state = NULL;
 
-  int status = lua_script_init(script);
-  if (status != 0) {
-    lua_script_free(script);
-    return status;
-  }
+  lua_State *L = lua_state_create(script, script_path, replica);
+  if (L == NULL)
+    return -1;
 
-  status = luaL_loadfile(script->lua_state, script_path);
+  int status = luaL_loadfile(L, script_path);
   if (status != 0) {
-    ERROR("Lua plugin: luaL_loadfile failed: %s",
-          lua_tostring(script->lua_state, -1));
-    lua_pop(script->lua_state, 1);
-    lua_script_free(script);
+    ERROR("Lua plugin: luaL_loadfile failed: %s", lua_tostring(L, -1));
+    lua_close(L);
     return -1;
   }
 
-  lua_pushstring(script->lua_state, script_path);
-  lua_setfield(script->lua_state, LUA_REGISTRYINDEX, "collectd:script_path");
-  lua_pushinteger(script->lua_state, 0);
-  lua_setfield(script->lua_state, LUA_REGISTRYINDEX, "collectd:callback_num");
-
-  status = lua_pcall(script->lua_state,
+  status = lua_pcall(L,
                      /* nargs = */ 0,
                      /* nresults = */ LUA_MULTRET,
                      /* errfunc = */ 0);
   if (status != 0) {
-    const char *errmsg = lua_tostring(script->lua_state, -1);
+    const char *errmsg = lua_tostring(L, -1);
 
     if (errmsg == NULL)
       ERROR("Lua plugin: lua_pcall failed with status %i. "
@@ -484,6 +810,78 @@ static int lua_script_load(const char *script_path) /* {{{ */
             errmsg);
   }
 
+  /* Drop whatever the script returned. */
+  lua_settop(L, 0);
+
+  if ((status != 0) && replica) {
+    lua_close(L);
+    return -1;
+  }
+
+  *ret_state = L;
+  return (status != 0) ? -1 : 0;
+} /* }}} int lua_state_load */
+
+static int lua_script_load(const char *script_path) /* {{{ */
+{
+  lua_script_t *script = calloc(1, sizeof(*script));
+  if (script == NULL) {
+    ERROR("Lua plugin: calloc failed.");
+    return -1;
+  }
+  pthread_mutex_init(&script->lock, NULL);
+  pthread_cond_init(&script->cond, NULL);
+
+  script->states = calloc(state_pool_size, sizeof(*script->states));
+  script->free_states = calloc(state_pool_size, sizeof(*script->free_states));
+  if ((script->states == NULL) || (script->free_states == NULL)) {
+    ERROR("Lua plugin: calloc failed.");
+    lua_script_free(script);
+    return -1;
+  }
+
+  lua_State *L = NULL;
+  int status = lua_state_load(script, script_path, /* replica = */ false, &L);
+  if (L == NULL) {
+    lua_script_free(script);
+    return -1;
+  }
+  script->states[0] = L;
+  script->states_num = 1;
+
+  /* Independent copies of stateless scripts, so that their callbacks can run
+   * in parallel. */
+  if ((status == 0) && script->stateless) {
+    while (script->states_num < state_pool_size) {
+      lua_State *replica = NULL;
+      if (lua_state_load(script, script_path, /* replica = */ true,
+                         &replica) != 0)
+        break;
+
+      lua_getfield(replica, LUA_REGISTRYINDEX, "collectd:callbacks");
+      int callbacks_num = (int)lua_rawlen(replica, -1);
+      lua_pop(replica, 1);
+      if (callbacks_num != script->callbacks_num) {
+        ERROR("Lua plugin: Script \"%s\" registered %d callbacks instead of "
+              "%d when loaded again.",
+              script_path, callbacks_num, script->callbacks_num);
+        lua_close(replica);
+        break;
+      }
+
+      script->states[script->states_num++] = replica;
+    }
+
+    if (script->states_num < state_pool_size)
+      WARNING("Lua plugin: Only %" PRIsz " of %" PRIsz " states could be "
+              "created for script \"%s\".",
+              script->states_num, state_pool_size, script_path);
+  }
+
+  for (size_t i = 0; i < script->states_num; i++)
+    script->free_states[i] = i;
+  script->free_states_num = script->states_num;
+
   /* Append this script to the global list of scripts. */
   if (scripts) {
     lua_script_t *last = scripts;
@@ -518,6 +916,22 @@ static int lua_config_base_path(const oconfig_item_t *ci) /* {{{ */
   return 0;
 } /* }}} int lua_config_base_path */
 
+static int lua_config_state_pool_size(const oconfig_item_t *ci) /* {{{ */
+{
+  int size = 0;
+  int status = cf_util_get_int(ci, &size);
+  if (status != 0)
+    return status;
+
+  if ((size < 1) || (size > 256)) {
+    ERROR("Lua plugin: `%s' must be between 1 and 256.", ci->key);
+    return -1;
+  }
+
+  state_pool_size = (size_t)size;
+  return 0;
+} /* }}} int lua_config_state_pool_size */
+
 static int lua_config_script(const oconfig_item_t *ci) /* {{{ */
 {
   char rel_path[PATH_MAX];
@@ -547,6 +961,7 @@ static int lua_config_script(const oconfig_item_t *ci) /* {{{ */
 /*
  * <Plugin lua>
  *   BasePath "/"
+ *   StatePoolSize 4
  *   Script "script1.lua"
  *   Script "script2.lua"
  * </Plugin>
@@ -559,6 +974,8 @@ static int lua_config(oconfig_item_t *ci) /* {{{ */
 
     if (strcasecmp("BasePath", child->key) == 0) {
       status = lua_config_base_path(child);
+    } else if (strcasecmp("StatePoolSize", child->key) == 0) {
+      status = lua_config_state_pool_size(child);
     } else if (strcasecmp("Script", child->key) == 0) {
       status = lua_config_script(child);
     } else {
@@ -572,7 +989,16 @@ static int lua_config(oconfig_item_t *ci) /* {{{ */
 
 static int lua_shutdown(void) /* {{{ */
 {
+  /* The batch writers need the states to deliver what is left in their
+   * queues. */
+  pthread_mutex_lock(&batch_writers_lock);
+  for (clua_callback_data_t *cb = batch_writers; cb != NULL;
+       cb = cb->next_batch)
+    clua_write_batch_stop(cb);
+  pthread_mutex_unlock(&batch_writers_lock);
+
   lua_script_free(scripts);
+  scripts = NULL;
 
   return 0;
 } /* }}} int lua_shutdown */
@@ -53,6 +53,11 @@ typedef struct mr_regex_s mr_regex_t;
 struct mr_regex_s {
   regex_t re;
   char *re_str;
+  /* If `re_str' is "^literal" or "^literal$": the literal, which is compared
+   * instead of calling regexec(). NULL otherwise. */
+  char *literal;
+  size_t literal_len;
+  bool literal_exact;
 
   mr_regex_t *next;
 };
@@ -80,6 +85,7 @@ static void mr_free_regex(mr_regex_t *r) /* {{{ */
   regfree(&r->re);
   memset(&r->re, 0, sizeof(r->re));
   sfree(r->re_str);
+  sfree(r->literal);
 
   if (r->next != NULL)
     mr_free_regex(r->next);
@@ -112,9 +118,15 @@ static int mr_match_regexen(mr_regex_t *re_head, /* {{{ */
   for (mr_regex_t *re = re_head; re != NULL; re = re->next) {
     int status;
 
-    status = regexec(&re->re, string,
-                     /* nmatch = */ 0, /* pmatch = */ NULL,
-                     /* eflags = */ 0);
+    if (re->literal == NULL)
+      status = regexec(&re->re, string,
+                       /* nmatch = */ 0, /* pmatch = */ NULL,
+                       /* eflags = */ 0);
+    else if (re->literal_exact)
+      status = strcmp(string, re->literal);
+    else
+      status = strncmp(string, re->literal, re->literal_len);
+
     if (status == 0) {
       DEBUG("regex match: Regular expression `%s' matches `%s'.", re->re_str,
             string);
@@ -128,6 +140,64 @@ static int mr_match_regexen(mr_regex_t *re_head, /* {{{ */
   return FC_MATCH_MATCHES;
 } /* }}} int mr_match_regexen */
 
+/* If `re_str' is of the form "^literal" or "^literal$", copies the literal to
+ * `buffer' and sets `exact' accordingly. Returns zero on success. */
+static int mr_regex_literal(char const *re_str, char *buffer, /* {{{ */
+                            size_t buffer_size, bool *exact) {
+  size_t len = 0;
+
+  if (re_str[0] != '^')
+    return -1;
+
+  for (char const *c = re_str + 1; *c != 0; c++) {
+    if ((c[0] == '$') && (c[1] == 0)) {
+      *exact = true;
+      buffer[len] = 0;
+      return 0;
+    }
+
+    if (c[0] == '\\') {
+      /* An escaped punctuation character stands for itself. */
+      if (!ispunct((unsigned char)c[1]))
+        return -1;
+      c++;
+    } else if (strchr(".[]()*+?{}|^$", c[0]) != NULL) {
+      return -1;
+    }
+
+    if (len + 1 >= buffer_size)
+      return -1;
+    buffer[len++] = c[0];
+  }
+
+  /* A quantifier would have returned above, so the last character isn't
+   * optional. */
+  *exact = false;
+  buffer[len] = 0;
+  return 0;
+} /* }}} int mr_regex_literal */
+
+/* Sets (`buffer', `exact') to the most specific literal found in the regular
+ * expressions `re_head'. Returns true if it is the only regular expression. */
+static bool mr_regex_constraint(mr_regex_t *re_head, char *buffer, /* {{{ */
+                                size_t buffer_size, bool *exact) {
+  buffer[0] = 0;
+  *exact = false;
+
+  for (mr_regex_t *re = re_head; re != NULL; re = re->next) {
+    if ((re->literal == NULL) || (re->literal_len >= buffer_size) || *exact)
+      continue;
+    if (re->literal_exact || (re->literal_len > strlen(buffer))) {
+      sstrncpy(buffer, re->literal, buffer_size);
+      *exact = re->literal_exact;
+    }
+  }
+
+  return (re_head == NULL) ||
+         ((re_head->next == NULL) && (re_head->literal != NULL) &&
+          (re_head->literal_len < buffer_size));
+} /* }}} bool mr_regex_constraint */
+
 static int mr_add_regex(mr_regex_t **re_head, const char *re_str, /* {{{ */
                         const char *option) {
   mr_regex_t *re;
@@ -159,6 +229,14 @@ static int mr_add_regex(mr_regex_t **re_head, const char *re_str, /* {{{ */
     return -1;
   }
 
+  re->literal = malloc(strlen(re_str) + 1);
+  if ((re->literal != NULL) &&
+      (mr_regex_literal(re_str, re->literal, strlen(re_str) + 1,
+                        &re->literal_exact) == 0))
+    re->literal_len = strlen(re->literal);
+  else
+    sfree(re->literal);
+
   if (*re_head == NULL) {
     *re_head = re;
   } else {
@@ -357,11 +435,36 @@ static int mr_match(const data_set_t __attribute__((unused)) * ds, /* {{{ */
   return match_value;
 } /* }}} int mr_match */
 
+static int mr_constraint(fc_constraint_t *c, void **user_data) /* {{{ */
+{
+  mr_match_t *m;
+
+  if ((user_data == NULL) || (*user_data == NULL))
+    return -1;
+
+  m = *user_data;
+
+  /* With `Invert', the match matches what the regular expressions don't. */
+  if (m->invert)
+    return -1;
+
+  bool plugin_only = mr_regex_constraint(m->plugin, c->plugin,
+                                         sizeof(c->plugin), &c->plugin_exact);
+  bool type_only =
+      mr_regex_constraint(m->type, c->type, sizeof(c->type), &c->type_exact);
+
+  c->sufficient = plugin_only && type_only && (m->host == NULL) &&
+                  (m->plugin_instance == NULL) && (m->type_instance == NULL) &&
+                  (m->meta == NULL);
+  return 0;
+} /* }}} int mr_constraint */
+
 void module_register(void) {
   match_proc_t mproc = {0};
 
   mproc.create = mr_create;
   mproc.destroy = mr_destroy;
   mproc.match = mr_match;
+  mproc.constraint = mr_constraint;
   fc_register_match("regex", mproc);
 } /* module_register */
@@ -46,6 +46,10 @@
 #define MEMCACHED_DEF_PORT "11211"
 #define MEMCACHED_CONNECT_TIMEOUT 10000
 #define MEMCACHED_IO_TIMEOUT 5000
+#define MEMCACHED_BUFFER_SIZE 4096
+/* In concurrent mode, failed connections are retried after 1, 2, 4, ...
+ * intervals, at most after this many. */
+#define MEMCACHED_MAX_BACKOFF 32
 
 struct prev_s {
   derive_t hits;
@@ -58,6 +62,14 @@ struct prev_s {
 
 typedef struct prev_s prev_t;
 
+/* State of an instance while memcached_read_all() is polling it. */
+enum memcached_state_e {
+  MEMCACHED_IDLE,
+  MEMCACHED_CONNECTING,
+  MEMCACHED_RECEIVING,
+  MEMCACHED_DONE,
+};
+
 struct memcached_s {
   char *name;
   char *host;
@@ -66,10 +78,22 @@ struct memcached_s {
   char *connport;
   int fd;
   prev_t prev;
+
+  /* concurrent mode only */
+  enum memcached_state_e state;
+  cdtime_t connect_after;
+  cdtime_t connect_backoff;
+  char buffer[MEMCACHED_BUFFER_SIZE];
+  size_t buffer_fill;
 };
 typedef struct memcached_s memcached_t;
 
 static bool memcached_have_instances;
+/* Instances are registered in the init callback, either with one read
+ * callback each or, in concurrent mode, all of them with a single one. */
+static bool memcached_concurrent;
+static memcached_t **memcached_instances;
+static size_t memcached_instances_num;
 
 static void memcached_free(void *arg) {
   memcached_t *st = arg;
@@ -123,7 +147,9 @@ static int memcached_connect_unix(memcached_t *st) {
   return fd;
 } /* int memcached_connect_unix */
 
-static int memcached_connect_inet(memcached_t *st) {
+/* If "in_progress" is not NULL, doesn't wait for the connection to be
+ * established but sets "*in_progress" if it is still pending. */
+static int memcached_connect_inet(memcached_t *st, bool *in_progress) {
   struct addrinfo *ai_list;
   int fd = -1;
 
@@ -169,6 +195,11 @@ static int memcached_connect_inet(memcached_t *st) {
       continue;
     }
 
+    if (in_progress != NULL) {
+      *in_progress = (status != 0);
+      break;
+    }
+
     /* Wait until connection establishes */
     struct pollfd pollfd = {
         .fd = fd,
@@ -207,7 +238,7 @@ static void memcached_connect(memcached_t *st) {
   if (st->socket != NULL)
     st->fd = memcached_connect_unix(st);
   else
-    st->fd = memcached_connect_inet(st);
+    st->fd = memcached_connect_inet(st, /* in_progress = */ NULL);
 
   if (st->fd >= 0)
     INFO("memcached plugin: Instance \"%s\": connection established.",
@@ -442,8 +473,7 @@ static gauge_t calculate_ratio_percent2(derive_t part1, derive_t part2,
   return 100.0 * (gauge_t)num / (gauge_t)denom;
 }
 
-static int memcached_read(user_data_t *user_data) {
-  char buf[4096];
+static void memcached_submit_stats(memcached_t *st, char *buf) {
   char *fields[3];
   char *line;
 
@@ -460,14 +490,8 @@ static int memcached_read(user_data_t *user_data) {
   derive_t octets_rx = 0;
   derive_t octets_tx = 0;
 
-  memcached_t *st = user_data->data;
   prev_t *prev = &st->prev;
 
-  /* get data from daemon */
-  if (memcached_query_daemon(buf, sizeof(buf), st) < 0) {
-    return -1;
-  }
-
 #define FIELD_IS(cnst)                                                         \
   (((sizeof(cnst) - 1) == name_len) && (strcmp(cnst, fields[1]) == 0))
 
@@ -628,10 +652,238 @@ static int memcached_read(user_data_t *user_data) {
     submit_gauge("percent", "decr_hitratio", ratio, st);
     submit_derive("memcached_ops", "decr", decr_hits + decr_misses, st);
   }
+} /* void memcached_submit_stats */
 
+static int memcached_read(user_data_t *user_data) {
+  char buf[MEMCACHED_BUFFER_SIZE];
+
+  memcached_t *st = user_data->data;
+
+  /* get data from daemon */
+  if (memcached_query_daemon(buf, sizeof(buf), st) < 0) {
+    return -1;
+  }
+
+  memcached_submit_stats(st, buf);
   return 0;
 } /* int memcached_read */
 
+/*
+ * Concurrent mode: all instances are polled by a single read callback, using
+ * non-blocking sockets.
+ */
+static void memcached_close(memcached_t *st) {
+  shutdown(st->fd, SHUT_RDWR);
+  close(st->fd);
+  st->fd = -1;
+  st->state = MEMCACHED_IDLE;
+}
+
+static void memcached_connect_failed(memcached_t *st, cdtime_t now) {
+  cdtime_t interval = plugin_get_interval();
+
+  if (st->connect_backoff == 0)
+    st->connect_backoff = interval;
+  else if (st->connect_backoff < MEMCACHED_MAX_BACKOFF * interval)
+    st->connect_backoff *= 2;
+  st->connect_after = now + st->connect_backoff;
+
+  ERROR("memcached plugin: Instance \"%s\" could not connect to daemon. "
+        "Retrying in %.3f seconds.",
+        st->name, CDTIME_T_TO_DOUBLE(st->connect_backoff));
+}
+
+static void memcached_connect_succeeded(memcached_t *st) {
+  if (st->connect_backoff != 0)
+    INFO("memcached plugin: Instance \"%s\": connection established.",
+         st->name);
+  st->connect_backoff = 0;
+  st->connect_after = 0;
+}
+
+static void memcached_send_stats(memcached_t *st) {
+  /* The request is small enough to always fit into the socket buffer. */
+  if (swrite(st->fd, "stats\r\n", strlen("stats\r\n")) != 0) {
+    ERROR("memcached plugin: Instance \"%s\": write(2) failed: %s", st->name,
+          STRERRNO);
+    memcached_close(st);
+    return;
+  }
+
+  st->buffer_fill = 0;
+  st->state = MEMCACHED_RECEIVING;
+}
+
+static void memcached_start(memcached_t *st, cdtime_t now) {
+  st->state = MEMCACHED_IDLE;
+
+  if (st->fd < 0) {
+    bool in_progress = false;
+
+    if (now < st->connect_after)
+      return;
+
+    if (st->socket != NULL)
+      st->fd = memcached_connect_unix(st);
+    else
+      st->fd = memcached_connect_inet(st, &in_progress);
+
+    if (st->fd < 0) {
+      memcached_connect_failed(st, now);
+      return;
+    }
+
+    if (in_progress) {
+      st->state = MEMCACHED_CONNECTING;
+      return;
+    }
+    memcached_connect_succeeded(st);
+  }
+
+  memcached_send_stats(st);
+}
+
+static void memcached_handle_connect(memcached_t *st, cdtime_t now) {
+  int socket_error = 0;
+  int status = getsockopt(st->fd, SOL_SOCKET, SO_ERROR, (void *)&socket_error,
+                          &(socklen_t){sizeof(socket_error)});
+  if ((status != 0) || (socket_error != 0)) {
+    memcached_close(st);
+    memcached_connect_failed(st, now);
+    return;
+  }
+
+  memcached_connect_succeeded(st);
+  memcached_send_stats(st);
+}
+
+static void memcached_handle_recv(memcached_t *st) {
+  char const end_token[5] = {'E', 'N', 'D', '\r', '\n'};
+
+  ssize_t status;
+  do
+    status = recv(st->fd, st->buffer + st->buffer_fill,
+                  sizeof(st->buffer) - st->buffer_fill - 1, /* flags = */ 0);
+  while (status < 0 && errno == EINTR);
+
+  if (status < 0) {
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+      return;
+
+    ERROR("memcached plugin: Instance \"%s\": Error reading from socket: %s",
+          st->name, STRERRNO);
+    memcached_close(st);
+    return;
+  } else if (status == 0) {
+    ERROR("memcached plugin: Instance \"%s\": Connection closed by peer",
+          st->name);
+    memcached_close(st);
+    return;
+  }
+
+  st->buffer_fill += (size_t)status;
+  st->buffer[st->buffer_fill] = 0;
+
+  if (st->buffer_fill == sizeof(st->buffer) - 1) {
+    WARNING("memcached plugin: Instance \"%s\": Message was truncated.",
+            st->name);
+    memcached_close(st);
+    st->state = MEMCACHED_DONE;
+    return;
+  }
+
+  /* If buffer ends in end_token, we have all the data. */
+  if ((st->buffer_fill >= sizeof(end_token)) &&
+      (memcmp(st->buffer + st->buffer_fill - sizeof(end_token), end_token,
+              sizeof(end_token)) == 0))
+    st->state = MEMCACHED_DONE;
+}
+
+static int memcached_read_all(__attribute__((unused)) user_data_t *ud) {
+  size_t num = memcached_instances_num;
+  struct pollfd pollfds[num];
+  memcached_t *polled[num];
+  size_t success = 0;
+
+  cdtime_t now = cdtime();
+  cdtime_t deadline = now + MS_TO_CDTIME_T(MEMCACHED_IO_TIMEOUT);
+
+  for (size_t i = 0; i < num; i++)
+    memcached_start(memcached_instances[i], now);
+
+  while (42) {
+    size_t polled_num = 0;
+
+    for (size_t i = 0; i < num; i++) {
+      memcached_t *st = memcached_instances[i];
+      if ((st->state != MEMCACHED_CONNECTING) &&
+          (st->state != MEMCACHED_RECEIVING))
+        continue;
+
+      pollfds[polled_num] = (struct pollfd){
+          .fd = st->fd,
+          .events = (st->state == MEMCACHED_CONNECTING) ? POLLOUT : POLLIN,
+      };
+      polled[polled_num] = st;
+      polled_num++;
+    }
+
+    if (polled_num == 0)
+      break;
+
+    now = cdtime();
+    if (now >= deadline) {
+      for (size_t i = 0; i < polled_num; i++) {
+        ERROR("memcached plugin: Instance \"%s\": Timeout %s",
+              polled[i]->name,
+              (polled[i]->state == MEMCACHED_CONNECTING)
+                  ? "connecting to daemon"
+                  : "reading from socket");
+        if (polled[i]->state == MEMCACHED_CONNECTING) {
+          memcached_close(polled[i]);
+          memcached_connect_failed(polled[i], now);
+        } else {
+          memcached_close(polled[i]);
+        }
+      }
+      break;
+    }
+
+    int status = poll(pollfds, (nfds_t)polled_num,
+                      (int)CDTIME_T_TO_MS(deadline - now) + 1);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      ERROR("memcached plugin: poll(2) failed: %s", STRERRNO);
+      for (size_t i = 0; i < polled_num; i++)
+        memcached_close(polled[i]);
+      break;
+    }
+
+    for (size_t i = 0; i < polled_num; i++) {
+      if (pollfds[i].revents == 0)
+        continue;
+
+      if (polled[i]->state == MEMCACHED_CONNECTING)
+        memcached_handle_connect(polled[i], now);
+      else
+        memcached_handle_recv(polled[i]);
+    }
+  } /* while (42) */
+
+  for (size_t i = 0; i < num; i++) {
+    memcached_t *st = memcached_instances[i];
+    if (st->state != MEMCACHED_DONE)
+      continue;
+
+    memcached_submit_stats(st, st->buffer);
+    st->state = MEMCACHED_IDLE;
+    success++;
+  }
+
+  return (success > 0) ? 0 : -1;
+} /* int memcached_read_all */
+
 static int memcached_set_defaults(memcached_t *st) {
   /* If no <Address> used then:
    * - Connect to the destination specified by <Host>, if present.
@@ -679,14 +931,30 @@ static int memcached_set_defaults(memcached_t *st) {
   return 0;
 } /* int memcached_set_defaults */
 
-static int memcached_add_read_callback(memcached_t *st) {
-  char callback_name[3 * DATA_MAX_NAME_LEN];
-
+static int memcached_add_instance(memcached_t *st) {
   if (memcached_set_defaults(st) != 0) {
     memcached_free(st);
     return -1;
   }
 
+  memcached_t **tmp =
+      realloc(memcached_instances,
+              sizeof(*memcached_instances) * (memcached_instances_num + 1));
+  if (tmp == NULL) {
+    ERROR("memcached plugin: realloc failed.");
+    memcached_free(st);
+    return ENOMEM;
+  }
+  memcached_instances = tmp;
+  memcached_instances[memcached_instances_num] = st;
+  memcached_instances_num++;
+
+  return 0;
+} /* int memcached_add_instance */
+
+static int memcached_add_read_callback(memcached_t *st) {
+  char callback_name[3 * DATA_MAX_NAME_LEN];
+
   snprintf(callback_name, sizeof(callback_name), "memcached/%s",
            (st->name != NULL) ? st->name : "__legacy__");
 
@@ -708,6 +976,7 @@ static int memcached_add_read_callback(memcached_t *st) {
  *     Address 1.2.3.4
  *     Port "1234"
  *   </Instance>
+ *   Concurrent false
  * </Plugin>
  */
 static int config_add_instance(oconfig_item_t *ci) {
@@ -749,6 +1018,10 @@ static int config_add_instance(oconfig_item_t *ci) {
       status = cf_util_get_string(child, &st->connhost);
     else if (strcasecmp("Port", child->key) == 0)
       status = cf_util_get_service(child, &st->connport);
+    else if ((strcasecmp("Concurrent", child->key) == 0) &&
+             (strcasecmp(ci->key, "Instance") != 0))
+      /* legacy configuration, handled by memcached_config() */
+      continue;
     else {
       WARNING("memcached plugin: Option `%s' not allowed here.", child->key);
       status = -1;
@@ -763,7 +1036,7 @@ static int config_add_instance(oconfig_item_t *ci) {
     return -1;
   }
 
-  return memcached_add_read_callback(st);
+  return memcached_add_instance(st);
 } /* int config_add_instance */
 
 static int memcached_config(oconfig_item_t *ci) {
@@ -772,7 +1045,16 @@ static int memcached_config(oconfig_item_t *ci) {
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
 
-    if (strcasecmp("Instance", child->key) == 0) {
+    if (strcasecmp("Concurrent", child->key) == 0)
+      cf_util_get_boolean(child, &memcached_concurrent);
+  }
+
+  for (int i = 0; i < ci->children_num; i++) {
+    oconfig_item_t *child = ci->children + i;
+
+    if (strcasecmp("Concurrent", child->key) == 0) {
+      continue;
+    } else if (strcasecmp("Instance", child->key) == 0) {
       config_add_instance(child);
       have_instance_block = 1;
     } else if (!have_instance_block) {
@@ -790,26 +1072,57 @@ static int memcached_config(oconfig_item_t *ci) {
   return 0;
 } /* int memcached_config */
 
+static void memcached_free_all(__attribute__((unused)) void *arg) {
+  for (size_t i = 0; i < memcached_instances_num; i++)
+    memcached_free(memcached_instances[i]);
+  sfree(memcached_instances);
+  memcached_instances_num = 0;
+}
+
 static int memcached_init(void) {
+  if (!memcached_have_instances) {
+    /* No instances were configured, lets start a default instance. */
+    memcached_t *st = calloc(1, sizeof(*st));
+    if (st == NULL)
+      return ENOMEM;
+    st->name = NULL;
+    st->host = NULL;
+    st->socket = NULL;
+    st->connhost = NULL;
+    st->connport = NULL;
 
-  if (memcached_have_instances)
-    return 0;
+    st->fd = -1;
 
-  /* No instances were configured, lets start a default instance. */
-  memcached_t *st = calloc(1, sizeof(*st));
-  if (st == NULL)
-    return ENOMEM;
-  st->name = NULL;
-  st->host = NULL;
-  st->socket = NULL;
-  st->connhost = NULL;
-  st->connport = NULL;
+    int status = memcached_add_instance(st);
+    if (status != 0)
+      return status;
+    memcached_have_instances = true;
+  }
 
-  st->fd = -1;
+  if (memcached_instances_num == 0)
+    return 0;
 
-  int status = memcached_add_read_callback(st);
-  if (status == 0)
-    memcached_have_instances = true;
+  if (memcached_concurrent) {
+    /* the instances are owned by the read callback now */
+    return plugin_register_complex_read(
+        /* group = */ "memcached",
+        /* name      = */ "memcached",
+        /* callback  = */ memcached_read_all,
+        /* interval  = */ 0,
+        &(user_data_t){
+            .free_func = memcached_free_all,
+        });
+  }
+
+  int status = 0;
+  for (size_t i = 0; i < memcached_instances_num; i++) {
+    int tmp = memcached_add_read_callback(memcached_instances[i]);
+    if (tmp != 0)
+      status = tmp;
+  }
+  /* the instances are owned by their read callbacks now */
+  sfree(memcached_instances);
+  memcached_instances_num = 0;
 
   return status;
 } /* int memcached_init */
@@ -27,6 +27,7 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/procfs/procfs.h"
 
 #if (defined(HAVE_SYS_SYSCTL_H) && defined(HAVE_SYSCTLBYNAME)) ||              \
     defined(__OpenBSD__)
@@ -78,7 +79,7 @@ static int pagesize;
 /* #endif HAVE_SYSCTLBYNAME */
 
 #elif KERNEL_LINUX
-/* no global variables */
+static cu_procfs_t *meminfo;
 /* #endif KERNEL_LINUX */
 
 #elif HAVE_LIBKSTAT
@@ -316,60 +317,48 @@ static int memory_read_internal(value_list_t *vl) {
   /* #endif HAVE_SYSCTLBYNAME */
 
 #elif KERNEL_LINUX
-  FILE *fh;
-  char buffer[1024];
-
-  char *fields[8];
-  int numfields;
-
-  bool detailed_slab_info = false;
-
-  gauge_t mem_total = 0;
-  gauge_t mem_used = 0;
-  gauge_t mem_buffered = 0;
-  gauge_t mem_cached = 0;
-  gauge_t mem_free = 0;
-  gauge_t mem_slab_total = 0;
-  gauge_t mem_slab_reclaimable = 0;
-  gauge_t mem_slab_unreclaimable = 0;
-
-  if ((fh = fopen("/proc/meminfo", "r")) == NULL) {
-    WARNING("memory: fopen: %s", STRERRNO);
+  enum {
+    KEY_MEM_TOTAL,
+    KEY_MEM_FREE,
+    KEY_BUFFERS,
+    KEY_CACHED,
+    KEY_SLAB,
+    KEY_SRECLAIMABLE,
+    KEY_SUNRECLAIM,
+  };
+  cu_procfs_key_t keys[] = {
+      [KEY_MEM_TOTAL] = {.key = "MemTotal:"},
+      [KEY_MEM_FREE] = {.key = "MemFree:"},
+      [KEY_BUFFERS] = {.key = "Buffers:"},
+      [KEY_CACHED] = {.key = "Cached:"},
+      [KEY_SLAB] = {.key = "Slab:"},
+      [KEY_SRECLAIMABLE] = {.key = "SReclaimable:"},
+      [KEY_SUNRECLAIM] = {.key = "SUnreclaim:"},
+  };
+
+  if ((meminfo == NULL) &&
+      ((meminfo = cu_procfs_open("/proc/meminfo")) == NULL)) {
+    WARNING("memory: open(/proc/meminfo): %s", STRERRNO);
     return -1;
   }
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
-    gauge_t *val = NULL;
-
-    if (strncasecmp(buffer, "MemTotal:", 9) == 0)
-      val = &mem_total;
-    else if (strncasecmp(buffer, "MemFree:", 8) == 0)
-      val = &mem_free;
-    else if (strncasecmp(buffer, "Buffers:", 8) == 0)
-      val = &mem_buffered;
-    else if (strncasecmp(buffer, "Cached:", 7) == 0)
-      val = &mem_cached;
-    else if (strncasecmp(buffer, "Slab:", 5) == 0)
-      val = &mem_slab_total;
-    else if (strncasecmp(buffer, "SReclaimable:", 13) == 0) {
-      val = &mem_slab_reclaimable;
-      detailed_slab_info = true;
-    } else if (strncasecmp(buffer, "SUnreclaim:", 11) == 0) {
-      val = &mem_slab_unreclaimable;
-      detailed_slab_info = true;
-    } else
-      continue;
-
-    numfields = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
-    if (numfields < 2)
-      continue;
-
-    *val = 1024.0 * atof(fields[1]);
+  if (cu_procfs_read_keys(meminfo, keys, STATIC_ARRAY_SIZE(keys)) < 0) {
+    WARNING("memory: reading /proc/meminfo failed: %s", STRERRNO);
+    return -1;
   }
 
-  if (fclose(fh)) {
-    WARNING("memory: fclose: %s", STRERRNO);
-  }
+  gauge_t mem_total = 1024.0 * (gauge_t)keys[KEY_MEM_TOTAL].value;
+  gauge_t mem_free = 1024.0 * (gauge_t)keys[KEY_MEM_FREE].value;
+  gauge_t mem_buffered = 1024.0 * (gauge_t)keys[KEY_BUFFERS].value;
+  gauge_t mem_cached = 1024.0 * (gauge_t)keys[KEY_CACHED].value;
+  gauge_t mem_slab_total = 1024.0 * (gauge_t)keys[KEY_SLAB].value;
+  gauge_t mem_slab_reclaimable =
+      1024.0 * (gauge_t)keys[KEY_SRECLAIMABLE].value;
+  gauge_t mem_slab_unreclaimable = 1024.0 * (gauge_t)keys[KEY_SUNRECLAIM].value;
+  gauge_t mem_used;
+
+  bool detailed_slab_info =
+      keys[KEY_SRECLAIMABLE].found || keys[KEY_SUNRECLAIM].found;
 
   if (mem_total < (mem_free + mem_buffered + mem_cached + mem_slab_total))
     return -1;
@@ -539,8 +528,20 @@ static int memory_read(void) /* {{{ */
   return memory_read_internal(&vl);
 } /* }}} int memory_read */
 
+#if KERNEL_LINUX
+static int memory_shutdown(void) /* {{{ */
+{
+  cu_procfs_close(meminfo);
+  meminfo = NULL;
+  return 0;
+} /* }}} int memory_shutdown */
+#endif
+
 void module_register(void) {
   plugin_register_complex_config("memory", memory_config);
   plugin_register_init("memory", memory_init);
   plugin_register_read("memory", memory_read);
+#if KERNEL_LINUX
+  plugin_register_shutdown("memory", memory_shutdown);
+#endif
 } /* void module_register */
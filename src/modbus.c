@@ -37,6 +37,10 @@
 /* Assume version 2.9.2 */
 #endif
 
+#ifndef MODBUS_MAX_READ_REGISTERS
+#define MODBUS_MAX_READ_REGISTERS 125
+#endif
+
 #ifndef MODBUS_TCP_DEFAULT_PORT
 #ifdef MODBUS_TCP_PORT
 #define MODBUS_TCP_DEFAULT_PORT MODBUS_TCP_PORT
@@ -62,6 +66,7 @@
  *   # Baudrate 38400
  *   # (Assumes 8N1)
  *   Interval 60
+ *   MaxRegisterGap 0
  *
  *   <Slave 1>
  *     Instance "foobar" # optional
@@ -116,14 +121,32 @@ struct mb_data_s /* {{{ */
   double scale;
   double shift;
 
+  /* Request the value is read with and the value's offset in that request's
+   * registers. Set by mb_plan_slave(). */
+  size_t range;
+  int range_offset;
+
   mb_data_t *next;
 }; /* }}} */
 
+/* One read request: a block of consecutive registers covering one or more
+ * values. */
+struct mb_range_s /* {{{ */
+{
+  mb_mreg_type_t modbus_register_type;
+  int register_base;
+  int registers_num;
+}; /* }}} */
+typedef struct mb_range_s mb_range_t;
+
 struct mb_slave_s /* {{{ */
 {
   int id;
   char instance[DATA_MAX_NAME_LEN];
   mb_data_t *collect;
+
+  mb_range_t *ranges;
+  size_t ranges_num;
 }; /* }}} */
 typedef struct mb_slave_s mb_slave_t;
 
@@ -136,6 +159,9 @@ struct mb_host_s /* {{{ */
   int baudrate;           /* for Modbus/RTU */
   mb_uarttype_t uarttype; /* UART type for Modbus/RTU */
   mb_conntype_t conntype;
+  /* Number of unused registers a request may span to read two values at
+   * once. */
+  int max_gap;
 
   mb_slave_t *slaves;
   size_t slaves_num;
@@ -414,6 +440,22 @@ static int mb_init_connection(mb_host_t *host) /* {{{ */
 } /* }}} int mb_init_connection */
 #endif /* !LEGACY_LIBMODBUS */
 
+static int mb_register_count(mb_register_type_t register_type) /* {{{ */
+{
+  if ((register_type == REG_TYPE_INT32) ||
+      (register_type == REG_TYPE_INT32_CDAB) ||
+      (register_type == REG_TYPE_UINT32) ||
+      (register_type == REG_TYPE_UINT32_CDAB) ||
+      (register_type == REG_TYPE_FLOAT) ||
+      (register_type == REG_TYPE_FLOAT_CDAB))
+    return 2;
+  else if ((register_type == REG_TYPE_INT64) ||
+           (register_type == REG_TYPE_UINT64))
+    return 4;
+  else
+    return 1;
+} /* }}} int mb_register_count */
+
 #define CAST_TO_VALUE_T(ds, vt, raw, scale, shift)                             \
   do {                                                                         \
     if ((ds)->ds[0].type == DS_TYPE_COUNTER)                                   \
@@ -426,56 +468,14 @@ static int mb_init_connection(mb_host_t *host) /* {{{ */
       (vt).absolute = (((absolute_t)(raw)*scale) + shift);                     \
   } while (0)
 
-static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
-                        mb_data_t *data) {
-  uint16_t values[4] = {0};
-  int values_num;
-  const data_set_t *ds;
+/* Reads the registers of "range" from "slave" into "values". */
+static int mb_read_range(mb_host_t *host, mb_slave_t *slave, /* {{{ */
+                         const mb_range_t *range, uint16_t *values) {
   int status = 0;
 
-  if ((host == NULL) || (slave == NULL) || (data == NULL))
+  if ((host == NULL) || (slave == NULL) || (range == NULL) || (values == NULL))
     return EINVAL;
 
-  ds = plugin_get_ds(data->type);
-  if (ds == NULL) {
-    ERROR("Modbus plugin: Type \"%s\" is not defined.", data->type);
-    return -1;
-  }
-
-  if (ds->ds_num != 1) {
-    ERROR("Modbus plugin: The type \"%s\" has %" PRIsz " data sources. "
-          "I can only handle data sets with only one data source.",
-          data->type, ds->ds_num);
-    return -1;
-  }
-
-  if ((ds->ds[0].type != DS_TYPE_GAUGE) &&
-      (data->register_type != REG_TYPE_INT32) &&
-      (data->register_type != REG_TYPE_INT32_CDAB) &&
-      (data->register_type != REG_TYPE_UINT32) &&
-      (data->register_type != REG_TYPE_UINT32_CDAB) &&
-      (data->register_type != REG_TYPE_INT64) &&
-      (data->register_type != REG_TYPE_UINT64)) {
-    NOTICE(
-        "Modbus plugin: The data source of type \"%s\" is %s, not gauge. "
-        "This will most likely result in problems, because the register type "
-        "is not UINT32 or UINT64.",
-        data->type, DS_TYPE_TO_STRING(ds->ds[0].type));
-  }
-
-  if ((data->register_type == REG_TYPE_INT32) ||
-      (data->register_type == REG_TYPE_INT32_CDAB) ||
-      (data->register_type == REG_TYPE_UINT32) ||
-      (data->register_type == REG_TYPE_UINT32_CDAB) ||
-      (data->register_type == REG_TYPE_FLOAT) ||
-      (data->register_type == REG_TYPE_FLOAT_CDAB))
-    values_num = 2;
-  else if ((data->register_type == REG_TYPE_INT64) ||
-           (data->register_type == REG_TYPE_UINT64))
-    values_num = 4;
-  else
-    values_num = 1;
-
   if (host->connection == NULL) {
     status = EBADF;
   } else if (host->conntype == MBCONN_TCP) {
@@ -519,21 +519,21 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
     return -1;
   }
 #endif
-  if (data->modbus_register_type == MREG_INPUT) {
-    status = modbus_read_input_registers(host->connection,
-                                         /* start_addr = */ data->register_base,
-                                         /* num_registers = */ values_num,
-                                         /* buffer = */ values);
+  if (range->modbus_register_type == MREG_INPUT) {
+    status = modbus_read_input_registers(
+        host->connection, /* start_addr = */ range->register_base,
+        /* num_registers = */ range->registers_num, /* buffer = */ values);
   } else {
     status = modbus_read_registers(host->connection,
-                                   /* start_addr = */ data->register_base,
-                                   /* num_registers = */ values_num,
+                                   /* start_addr = */ range->register_base,
+                                   /* num_registers = */ range->registers_num,
                                    /* buffer = */ values);
   }
-  if (status != values_num) {
+  if (status != range->registers_num) {
     ERROR("Modbus plugin: modbus read function (%s/%s) failed. "
-          " status = %i, start_addr = %i, values_num = %i. Giving up.",
-          host->host, host->node, status, data->register_base, values_num);
+          " status = %i, start_addr = %i, registers_num = %i. Giving up.",
+          host->host, host->node, status, range->register_base,
+          range->registers_num);
 #if LEGACY_LIBMODBUS
     modbus_close(&host->connection);
 #else
@@ -544,16 +544,55 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
     return -1;
   }
 
-  DEBUG("Modbus plugin: mb_read_data: Success! "
+  DEBUG("Modbus plugin: mb_read_range: Success! "
         "modbus_read_registers returned with status %i.",
         status);
 
+  return 0;
+} /* }}} int mb_read_range */
+
+/* Converts the registers at "values" to the value described by "data" and
+ * dispatches it. */
+static int mb_submit_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
+                          mb_data_t *data, const uint16_t *values) {
+  const data_set_t *ds;
+
+  if ((host == NULL) || (slave == NULL) || (data == NULL) || (values == NULL))
+    return EINVAL;
+
+  ds = plugin_get_ds(data->type);
+  if (ds == NULL) {
+    ERROR("Modbus plugin: Type \"%s\" is not defined.", data->type);
+    return -1;
+  }
+
+  if (ds->ds_num != 1) {
+    ERROR("Modbus plugin: The type \"%s\" has %" PRIsz " data sources. "
+          "I can only handle data sets with only one data source.",
+          data->type, ds->ds_num);
+    return -1;
+  }
+
+  if ((ds->ds[0].type != DS_TYPE_GAUGE) &&
+      (data->register_type != REG_TYPE_INT32) &&
+      (data->register_type != REG_TYPE_INT32_CDAB) &&
+      (data->register_type != REG_TYPE_UINT32) &&
+      (data->register_type != REG_TYPE_UINT32_CDAB) &&
+      (data->register_type != REG_TYPE_INT64) &&
+      (data->register_type != REG_TYPE_UINT64)) {
+    NOTICE(
+        "Modbus plugin: The data source of type \"%s\" is %s, not gauge. "
+        "This will most likely result in problems, because the register type "
+        "is not UINT32 or UINT64.",
+        data->type, DS_TYPE_TO_STRING(ds->ds[0].type));
+  }
+
   if (data->register_type == REG_TYPE_FLOAT) {
     float float_value;
     value_t vt;
 
     float_value = mb_register_to_float(values[0], values[1]);
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_submit_data: "
           "Returned float value is %g",
           (double)float_value);
 
@@ -564,7 +603,7 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
     value_t vt;
 
     float_value = mb_register_to_float(values[1], values[0]);
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_submit_data: "
           "Returned float value is %g",
           (double)float_value);
 
@@ -578,7 +617,7 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
     value_t vt;
 
     v.u32 = (((uint32_t)values[0]) << 16) | ((uint32_t)values[1]);
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_submit_data: "
           "Returned int32 value is %" PRIi32,
           v.i32);
 
@@ -592,7 +631,7 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
     value_t vt;
 
     v.u32 = (((uint32_t)values[1]) << 16) | ((uint32_t)values[0]);
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_submit_data: "
           "Returned int32 value is %" PRIi32,
           v.i32);
 
@@ -607,7 +646,7 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
 
     v.u16 = values[0];
 
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_submit_data: "
           "Returned int16 value is %" PRIi16,
           v.i16);
 
@@ -618,7 +657,7 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
     value_t vt;
 
     v32 = (((uint32_t)values[0]) << 16) | ((uint32_t)values[1]);
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_submit_data: "
           "Returned uint32 value is %" PRIu32,
           v32);
 
@@ -629,7 +668,7 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
     value_t vt;
 
     v32 = (((uint32_t)values[1]) << 16) | ((uint32_t)values[0]);
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_submit_data: "
           "Returned uint32 value is %" PRIu32,
           v32);
 
@@ -641,7 +680,7 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
 
     v64 = (((uint64_t)values[0]) << 48) | (((uint64_t)values[1]) << 32) |
           (((uint64_t)values[2]) << 16) | (((uint64_t)values[3]));
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_submit_data: "
           "Returned uint64 value is %" PRIu64,
           v64);
 
@@ -656,7 +695,7 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
 
     v.u64 = (((uint64_t)values[0]) << 48) | (((uint64_t)values[1]) << 32) |
             (((uint64_t)values[2]) << 16) | ((uint64_t)values[3]);
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_submit_data: "
           "Returned uint64 value is %" PRIi64,
           v.i64);
 
@@ -666,7 +705,7 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
   {
     value_t vt;
 
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_submit_data: "
           "Returned uint16 value is %" PRIu16,
           values[0]);
 
@@ -675,10 +714,11 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
   }
 
   return 0;
-} /* }}} int mb_read_data */
+} /* }}} int mb_submit_data */
 
 static int mb_read_slave(mb_host_t *host, mb_slave_t *slave) /* {{{ */
 {
+  uint16_t values[MODBUS_MAX_READ_REGISTERS];
   int success;
   int status;
 
@@ -686,10 +726,19 @@ static int mb_read_slave(mb_host_t *host, mb_slave_t *slave) /* {{{ */
     return EINVAL;
 
   success = 0;
-  for (mb_data_t *data = slave->collect; data != NULL; data = data->next) {
-    status = mb_read_data(host, slave, data);
-    if (status == 0)
-      success++;
+  for (size_t i = 0; i < slave->ranges_num; i++) {
+    status = mb_read_range(host, slave, slave->ranges + i, values);
+    if (status != 0)
+      continue;
+
+    for (mb_data_t *data = slave->collect; data != NULL; data = data->next) {
+      if (data->range != i)
+        continue;
+
+      status = mb_submit_data(host, slave, data, values + data->range_offset);
+      if (status == 0)
+        success++;
+    }
   }
 
   if (success == 0)
@@ -751,8 +800,10 @@ static void slaves_free_all(mb_slave_t *slaves, size_t slaves_num) /* {{{ */
   if (slaves == NULL)
     return;
 
-  for (size_t i = 0; i < slaves_num; i++)
+  for (size_t i = 0; i < slaves_num; i++) {
     data_free_all(slaves[i].collect);
+    sfree(slaves[i].ranges);
+  }
   sfree(slaves);
 } /* }}} void slaves_free_all */
 
@@ -968,6 +1019,83 @@ static int mb_config_add_slave(mb_host_t *host, oconfig_item_t *ci) /* {{{ */
   return status;
 } /* }}} int mb_config_add_slave */
 
+static int mb_data_compare(const void *a, const void *b) /* {{{ */
+{
+  const mb_data_t *d0 = *(mb_data_t *const *)a;
+  const mb_data_t *d1 = *(mb_data_t *const *)b;
+
+  if (d0->modbus_register_type != d1->modbus_register_type)
+    return (d0->modbus_register_type < d1->modbus_register_type) ? -1 : 1;
+  if (d0->register_base != d1->register_base)
+    return (d0->register_base < d1->register_base) ? -1 : 1;
+  return 0;
+} /* }}} int mb_data_compare */
+
+/* Plans the read requests for a slave. Values are sorted by register and
+ * neighbouring values of the same register type are read with a single
+ * request, as long as at most "max_gap" unused registers lie between them and
+ * the request stays within the protocol's limit of MODBUS_MAX_READ_REGISTERS
+ * registers. */
+static int mb_plan_slave(mb_slave_t *slave, int max_gap) /* {{{ */
+{
+  mb_data_t **sorted;
+  size_t data_num = 0;
+  mb_range_t *ranges;
+  size_t ranges_num = 0;
+
+  for (mb_data_t *data = slave->collect; data != NULL; data = data->next)
+    data_num++;
+
+  /* There are never more requests than values. */
+  sorted = calloc(data_num, sizeof(*sorted));
+  ranges = calloc(data_num, sizeof(*ranges));
+  if ((sorted == NULL) || (ranges == NULL)) {
+    sfree(sorted);
+    sfree(ranges);
+    return ENOMEM;
+  }
+
+  data_num = 0;
+  for (mb_data_t *data = slave->collect; data != NULL; data = data->next)
+    sorted[data_num++] = data;
+  qsort(sorted, data_num, sizeof(*sorted), mb_data_compare);
+
+  for (size_t i = 0; i < data_num; i++) {
+    mb_data_t *data = sorted[i];
+    int registers_num = mb_register_count(data->register_type);
+    mb_range_t *range = (ranges_num > 0) ? ranges + ranges_num - 1 : NULL;
+
+    if ((range == NULL) ||
+        (range->modbus_register_type != data->modbus_register_type) ||
+        (data->register_base >
+         range->register_base + range->registers_num + max_gap) ||
+        (data->register_base + registers_num - range->register_base >
+         MODBUS_MAX_READ_REGISTERS)) {
+      range = ranges + ranges_num;
+      ranges_num++;
+      *range = (mb_range_t){
+          .modbus_register_type = data->modbus_register_type,
+          .register_base = data->register_base,
+      };
+    }
+
+    data->range = (size_t)(range - ranges);
+    data->range_offset = data->register_base - range->register_base;
+    if (range->registers_num < data->range_offset + registers_num)
+      range->registers_num = data->range_offset + registers_num;
+  }
+
+  DEBUG("Modbus plugin: Reading %" PRIsz " values from slave %i with %" PRIsz
+        " requests.",
+        data_num, slave->id, ranges_num);
+
+  sfree(sorted);
+  sfree(slave->ranges);
+  slave->ranges = ranges;
+  slave->ranges_num = ranges_num;
+  return 0;
+} /* }}} int mb_plan_slave */
+
 static int mb_config_add_host(oconfig_item_t *ci) /* {{{ */
 {
   cdtime_t interval = 0;
@@ -1036,7 +1164,15 @@ static int mb_config_add_host(oconfig_item_t *ci) /* {{{ */
 #endif
     } else if (strcasecmp("Interval", child->key) == 0)
       status = cf_util_get_cdtime(child, &interval);
-    else if (strcasecmp("Slave", child->key) == 0)
+    else if (strcasecmp("MaxRegisterGap", child->key) == 0) {
+      status = cf_util_get_int(child, &host->max_gap);
+      if ((status == 0) && ((host->max_gap < 0) ||
+                            (host->max_gap >= MODBUS_MAX_READ_REGISTERS))) {
+        ERROR("Modbus plugin: MaxRegisterGap must be between 0 and %i.",
+              MODBUS_MAX_READ_REGISTERS - 1);
+        status = -1;
+      }
+    } else if (strcasecmp("Slave", child->key) == 0)
       /* Don't set status: Gracefully continue if a slave fails. */
       mb_config_add_slave(host, child);
     else {
@@ -1069,6 +1205,9 @@ static int mb_config_add_host(oconfig_item_t *ci) /* {{{ */
     status = -1;
   }
 
+  for (size_t i = 0; (status == 0) && (i < host->slaves_num); i++)
+    status = mb_plan_slave(host->slaves + i, host->max_gap);
+
   if (status == 0) {
     char name[1024];
 
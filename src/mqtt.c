@@ -49,10 +49,35 @@
 #ifndef SSL_VERIFY_PEER
 #define SSL_VERIFY_PEER 1
 #endif
+#define MQTT_DEFAULT_MAX_INFLIGHT 20
+#define MQTT_DEFAULT_SEND_QUEUE_LIMIT 10000
+#define MQTT_DEFAULT_BATCH_SIZE 256
+
+/* libmosquitto 1.0 and later run the network loop in a thread of their own
+ * (mosquitto_loop_start()), so that publishing doesn't wait for the broker. */
+#if LIBMOSQUITTO_MAJOR != 0
+#define MQTT_ASYNC_PUBLISH 1
+#else
+#define MQTT_ASYNC_PUBLISH 0
+#endif
 
 /*
  * Data types
  */
+
+/* Value lists received by a subscriber, dispatched together with
+ * plugin_dispatch_value_lists(). */
+typedef struct {
+  value_list_t *vls;
+  size_t num;
+  size_t size;
+
+  /* storage for the values of all value lists */
+  value_t *values;
+  size_t values_num;
+  size_t values_size;
+} mqtt_batch_t;
+
 struct mqtt_client_conf {
   bool publish;
   char *name;
@@ -76,14 +101,22 @@ struct mqtt_client_conf {
   char *topic_prefix;
   bool store_rates;
   bool retain;
+  int max_inflight;
+  /* messages passed to the library, but not sent (QoS 0) or acknowledged
+   * (QoS 1 and 2) yet; accessed atomically */
+  uint64_t queue_length;
+  uint64_t queue_limit;
+  bool loop_started;
 
   /* For subscribing */
   pthread_t thread;
   bool loop;
   char *topic;
   bool clean_session;
+  mqtt_batch_t batch;
 
   c_complain_t complaint_cantpublish;
+  c_complain_t complaint_connection;
   pthread_mutex_t lock;
 };
 typedef struct mqtt_client_conf mqtt_client_conf_t;
@@ -139,11 +172,24 @@ static void mqtt_free(mqtt_client_conf_t *conf) {
   if (conf == NULL)
     return;
 
+#if MQTT_ASYNC_PUBLISH
+  /* Disconnecting makes the network thread exit, even while it is waiting to
+   * reconnect. */
+  if (conf->loop_started) {
+    (void)mosquitto_disconnect(conf->mosq);
+    (void)mosquitto_loop_stop(conf->mosq, /* force = */ false);
+    conf->loop_started = false;
+    conf->connected = false;
+  }
+#endif
   if (conf->connected)
     (void)mosquitto_disconnect(conf->mosq);
   conf->connected = false;
   (void)mosquitto_destroy(conf->mosq);
 
+  sfree(conf->batch.vls);
+  sfree(conf->batch.values);
+
   sfree(conf->host);
   sfree(conf->username);
   sfree(conf->password);
@@ -173,17 +219,59 @@ static char *strip_prefix(char *topic) {
   return topic;
 }
 
+static void mqtt_batch_flush(mqtt_batch_t *batch) {
+  if (batch->num == 0)
+    return;
+
+  int failed = plugin_dispatch_value_lists(batch->vls, batch->num);
+  if (failed != 0)
+    WARNING("mqtt plugin: Dispatching %d of %" PRIsz " value lists failed.",
+            failed, batch->num);
+
+  batch->num = 0;
+  batch->values_num = 0;
+} /* void mqtt_batch_flush */
+
+/* Returns a value list of the batch with room for "values_num" values,
+ * flushing the batch first if it is full. */
+static value_list_t *mqtt_batch_next(mqtt_batch_t *batch, size_t values_num) {
+  if ((batch->num >= batch->size) ||
+      (batch->values_num + values_num > batch->values_size))
+    mqtt_batch_flush(batch);
+
+  if (values_num > batch->values_size) {
+    /* the batch is empty now, so no value list points into "values" */
+    size_t values_size = batch->size * values_num;
+    value_t *tmp = realloc(batch->values, values_size * sizeof(*tmp));
+    if (tmp == NULL) {
+      ERROR("mqtt plugin: realloc failed.");
+      return NULL;
+    }
+    batch->values = tmp;
+    batch->values_size = values_size;
+  }
+
+  value_list_t *vl = batch->vls + batch->num;
+  vl->values = batch->values + batch->values_num;
+  vl->values_len = values_num;
+  return vl;
+} /* value_list_t *mqtt_batch_next */
+
+/* The payload holds one or more values of the topic's identifier, one
+ * "<time>:<value>[:<value>...]" per line. */
 static void on_message(
 #if LIBMOSQUITTO_MAJOR == 0
 #else
     __attribute__((unused)) struct mosquitto *m,
 #endif
-    __attribute__((unused)) void *arg, const struct mosquitto_message *msg) {
+    void *arg, const struct mosquitto_message *msg) {
+  mqtt_client_conf_t *conf = arg;
   value_list_t vl = VALUE_LIST_INIT;
   data_set_t const *ds;
   char *topic;
   char *name;
   char *payload;
+  char *saveptr = NULL;
   int status;
 
   if (msg->payloadlen <= 0) {
@@ -208,34 +296,36 @@ static void on_message(
     return;
   }
 
-  vl.values = calloc(ds->ds_num, sizeof(*vl.values));
-  if (vl.values == NULL) {
-    ERROR("mqtt plugin: calloc failed.");
-    return;
-  }
-  vl.values_len = ds->ds_num;
-
   payload = malloc(msg->payloadlen + 1);
   if (payload == NULL) {
     ERROR("mqtt plugin: malloc for payload buffer failed.");
-    sfree(vl.values);
     return;
   }
   memmove(payload, msg->payload, msg->payloadlen);
   payload[msg->payloadlen] = 0;
 
   DEBUG("mqtt plugin: payload = \"%s\"", payload);
-  status = parse_values(payload, &vl, ds);
-  if (status != 0) {
-    ERROR("mqtt plugin: Unable to parse payload \"%s\".", payload);
-    sfree(payload);
-    sfree(vl.values);
-    return;
+  for (char *line = strtok_r(payload, "\r\n", &saveptr); line != NULL;
+       line = strtok_r(NULL, "\r\n", &saveptr)) {
+    value_list_t *dst = mqtt_batch_next(&conf->batch, ds->ds_num);
+    if (dst == NULL)
+      break;
+
+    value_t *values = dst->values;
+    *dst = vl;
+    dst->values = values;
+    dst->values_len = ds->ds_num;
+
+    status = parse_values(line, dst, ds);
+    if (status != 0) {
+      ERROR("mqtt plugin: Unable to parse payload \"%s\".", line);
+      continue;
+    }
+
+    conf->batch.num++;
+    conf->batch.values_num += ds->ds_num;
   }
   sfree(payload);
-
-  plugin_dispatch_values(&vl);
-  sfree(vl.values);
 } /* void on_message */
 
 static int mqtt_subscribe(mqtt_client_conf_t *conf) {
@@ -280,11 +370,70 @@ static int mqtt_reconnect(mqtt_client_conf_t *conf) {
   return 0;
 } /* mqtt_reconnect */
 
+#if MQTT_ASYNC_PUBLISH
+/* The following callbacks are called by the network thread of publishers. */
+static void on_connect(__attribute__((unused)) struct mosquitto *m, void *arg,
+                       int rc) {
+  mqtt_client_conf_t *conf = arg;
+
+  if (rc != 0) {
+    c_complain(LOG_ERR, &conf->complaint_connection,
+               "mqtt plugin: broker \"%s:%d\" refused the connection "
+               "(code %d).",
+               conf->host, conf->port, rc);
+    return;
+  }
+
+  /* QoS 0 messages queued before the connection was lost have been
+   * discarded; QoS 1 and 2 messages are sent again. */
+  if (conf->qos == 0)
+    __atomic_store_n(&conf->queue_length, 0, __ATOMIC_RELAXED);
+
+  __atomic_store_n(&conf->connected, true, __ATOMIC_RELEASE);
+  c_release(LOG_INFO, &conf->complaint_connection,
+            "mqtt plugin: successfully reconnected to broker \"%s:%d\"",
+            conf->host, conf->port);
+} /* void on_connect */
+
+static void on_disconnect(__attribute__((unused)) struct mosquitto *m,
+                          void *arg, int rc) {
+  mqtt_client_conf_t *conf = arg;
+
+  __atomic_store_n(&conf->connected, false, __ATOMIC_RELEASE);
+
+  /* rc is zero if mosquitto_disconnect() has been called */
+  if (rc != 0)
+    c_complain(LOG_ERR, &conf->complaint_connection,
+               "mqtt plugin: lost connection to broker \"%s:%d\"; "
+               "reconnecting in the background.",
+               conf->host, conf->port);
+} /* void on_disconnect */
+
+static void on_publish(__attribute__((unused)) struct mosquitto *m, void *arg,
+                       __attribute__((unused)) int mid) {
+  mqtt_client_conf_t *conf = arg;
+
+  /* don't wrap around if on_connect() has reset the counter */
+  uint64_t length = __atomic_load_n(&conf->queue_length, __ATOMIC_RELAXED);
+  while ((length > 0) &&
+         !__atomic_compare_exchange_n(&conf->queue_length, &length, length - 1,
+                                      /* weak = */ true, __ATOMIC_RELAXED,
+                                      __ATOMIC_RELAXED))
+    ;
+} /* void on_publish */
+#endif /* MQTT_ASYNC_PUBLISH */
+
 /* must hold conf->lock when calling. */
 static int mqtt_connect(mqtt_client_conf_t *conf) {
   char const *client_id;
   int status;
 
+#if MQTT_ASYNC_PUBLISH
+  /* the network thread reconnects on its own */
+  if (conf->loop_started)
+    return 0;
+#endif
+
   if (conf->mosq != NULL)
     return mqtt_reconnect(conf);
 
@@ -338,6 +487,23 @@ static int mqtt_connect(mqtt_client_conf_t *conf) {
   }
 #endif
 
+#if MQTT_ASYNC_PUBLISH
+  if (conf->publish) {
+    mosquitto_connect_callback_set(conf->mosq, on_connect);
+    mosquitto_disconnect_callback_set(conf->mosq, on_disconnect);
+    mosquitto_publish_callback_set(conf->mosq, on_publish);
+    mosquitto_reconnect_delay_set(conf->mosq, /* delay = */ 1,
+                                  /* delay_max = */ 30,
+                                  /* exponential = */ true);
+
+    status = mosquitto_max_inflight_messages_set(
+        conf->mosq, (unsigned int)conf->max_inflight);
+    if (status != MOSQ_ERR_SUCCESS)
+      WARNING("mqtt plugin: mosquitto_max_inflight_messages_set failed: %s",
+              mosquitto_strerror(status));
+  }
+#endif
+
   if (conf->username && conf->password) {
     status =
         mosquitto_username_pw_set(conf->mosq, conf->username, conf->password);
@@ -379,6 +545,21 @@ static int mqtt_connect(mqtt_client_conf_t *conf) {
     }
   }
 
+#if MQTT_ASYNC_PUBLISH
+  if (conf->publish) {
+    status = mosquitto_loop_start(conf->mosq);
+    if (status != MOSQ_ERR_SUCCESS) {
+      ERROR("mqtt plugin: mosquitto_loop_start failed: %s",
+            mosquitto_strerror(status));
+      mosquitto_disconnect(conf->mosq);
+      mosquitto_destroy(conf->mosq);
+      conf->mosq = NULL;
+      return -1;
+    }
+    conf->loop_started = true;
+  }
+#endif
+
   conf->connected = true;
   return 0;
 } /* mqtt_connect */
@@ -405,6 +586,9 @@ static void *subscribers_thread(void *arg) {
                             /* timeout[ms] = */ 1000,
                             /* max_packets = */ 100);
 #endif
+    /* the messages received by this iteration are dispatched together */
+    mqtt_batch_flush(&conf->batch);
+
     if (status == MOSQ_ERR_CONN_LOST) {
       conf->connected = false;
       continue;
@@ -436,6 +620,22 @@ static int publish(mqtt_client_conf_t *conf, char const *topic,
     return status;
   }
 
+#if MQTT_ASYNC_PUBLISH
+  /* The network thread sends the message; only make sure that the messages
+   * don't pile up while the broker is slow or unreachable. */
+  uint64_t length =
+      __atomic_add_fetch(&conf->queue_length, 1, __ATOMIC_RELAXED);
+  if ((conf->queue_limit > 0) && (length > conf->queue_limit)) {
+    __atomic_sub_fetch(&conf->queue_length, 1, __ATOMIC_RELAXED);
+    c_complain(LOG_ERR, &conf->complaint_cantpublish,
+               "mqtt plugin: %" PRIu64 " messages are waiting to be sent to "
+               "broker \"%s:%d\"; dropping values.",
+               conf->queue_limit, conf->host, conf->port);
+    pthread_mutex_unlock(&conf->lock);
+    return -1;
+  }
+#endif
+
   status = mosquitto_publish(conf->mosq, /* message_id */ NULL, topic,
 #if LIBMOSQUITTO_MAJOR == 0
                              (uint32_t)payload_len, payload,
@@ -443,6 +643,23 @@ static int publish(mqtt_client_conf_t *conf, char const *topic,
                              (int)payload_len, payload,
 #endif
                              conf->qos, conf->retain);
+#if MQTT_ASYNC_PUBLISH
+  if (status != MOSQ_ERR_SUCCESS) {
+    __atomic_sub_fetch(&conf->queue_length, 1, __ATOMIC_RELAXED);
+    c_complain(LOG_ERR, &conf->complaint_cantpublish,
+               "mqtt plugin: mosquitto_publish failed: %s",
+               (status == MOSQ_ERR_ERRNO) ? STRERRNO
+                                          : mosquitto_strerror(status));
+    pthread_mutex_unlock(&conf->lock);
+    return -1;
+  }
+
+  c_release(LOG_INFO, &conf->complaint_cantpublish,
+            "mqtt plugin: publishing to broker \"%s:%d\" again.", conf->host,
+            conf->port);
+  pthread_mutex_unlock(&conf->lock);
+  return 0;
+#else
   if (status != MOSQ_ERR_SUCCESS) {
     c_complain(LOG_ERR, &conf->complaint_cantpublish,
                "mqtt plugin: mosquitto_publish failed: %s",
@@ -483,6 +700,7 @@ static int publish(mqtt_client_conf_t *conf, char const *topic,
 
   pthread_mutex_unlock(&conf->lock);
   return 0;
+#endif /* !MQTT_ASYNC_PUBLISH */
 } /* int publish */
 
 static int format_topic(char *buf, size_t buf_len, data_set_t const *ds,
@@ -532,13 +750,8 @@ static int mqtt_write(const data_set_t *ds, const value_list_t *vl,
     return status;
   }
 
-  status = publish(conf, topic, payload, strlen(payload) + 1);
-  if (status != 0) {
-    ERROR("mqtt plugin: publish failed: %s", mosquitto_strerror(status));
-    return status;
-  }
-
-  return status;
+  /* publish() complains on its own */
+  return publish(conf, topic, payload, strlen(payload) + 1);
 } /* mqtt_write */
 
 /*
@@ -556,6 +769,8 @@ static int mqtt_write(const data_set_t *ds, const value_list_t *vl,
  *   CertificateFile "client-cert.pem"	  optional
  *   CertificateKeyFile "client-key.pem"  optional
  *   TLSProtocol "tlsv1.2"                optional
+ *   MaxInflightMessages 20
+ *   SendQueueLimit 10000
  * </Publish>
  */
 static int mqtt_config_publisher(oconfig_item_t *ci) {
@@ -583,6 +798,8 @@ static int mqtt_config_publisher(oconfig_item_t *ci) {
   conf->qos = 0;
   conf->topic_prefix = strdup(MQTT_DEFAULT_TOPIC_PREFIX);
   conf->store_rates = true;
+  conf->max_inflight = MQTT_DEFAULT_MAX_INFLIGHT;
+  conf->queue_limit = MQTT_DEFAULT_SEND_QUEUE_LIMIT;
 
   status = pthread_mutex_init(&conf->lock, NULL);
   if (status != 0) {
@@ -591,6 +808,7 @@ static int mqtt_config_publisher(oconfig_item_t *ci) {
   }
 
   C_COMPLAIN_INIT(&conf->complaint_cantpublish);
+  C_COMPLAIN_INIT(&conf->complaint_connection);
 
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
@@ -621,6 +839,21 @@ static int mqtt_config_publisher(oconfig_item_t *ci) {
       cf_util_get_boolean(child, &conf->store_rates);
     else if (strcasecmp("Retain", child->key) == 0)
       cf_util_get_boolean(child, &conf->retain);
+    else if (strcasecmp("MaxInflightMessages", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status != 0) || (tmp < 1))
+        ERROR("mqtt plugin: \"MaxInflightMessages\" must be positive.");
+      else
+        conf->max_inflight = tmp;
+    } else if (strcasecmp("SendQueueLimit", child->key) == 0) {
+      int tmp = -1;
+      status = cf_util_get_int(child, &tmp);
+      if ((status != 0) || (tmp < 0))
+        ERROR("mqtt plugin: \"SendQueueLimit\" must not be negative.");
+      else
+        conf->queue_limit = (uint64_t)tmp;
+    }
     else if (strcasecmp("CACert", child->key) == 0)
       cf_util_get_string(child, &conf->cacertificatefile);
     else if (strcasecmp("CertificateFile", child->key) == 0)
@@ -639,6 +872,7 @@ static int mqtt_config_publisher(oconfig_item_t *ci) {
   plugin_register_write(cb_name, mqtt_write,
                         &(user_data_t){
                             .data = conf,
+                            .free_func = (void *)mqtt_free,
                         });
   return 0;
 } /* mqtt_config_publisher */
@@ -655,6 +889,7 @@ static int mqtt_config_publisher(oconfig_item_t *ci) {
  *   CertificateFile "client-cert.pem"	  optional
  *   CertificateKeyFile "client-key.pem"  optional
  *   TLSProtocol "tlsv1.2"                optional
+ *   BatchSize 256
  * </Subscribe>
  */
 static int mqtt_config_subscriber(oconfig_item_t *ci) {
@@ -682,6 +917,7 @@ static int mqtt_config_subscriber(oconfig_item_t *ci) {
   conf->qos = 2;
   conf->topic = strdup(MQTT_DEFAULT_TOPIC);
   conf->clean_session = true;
+  conf->batch.size = MQTT_DEFAULT_BATCH_SIZE;
 
   status = pthread_mutex_init(&conf->lock, NULL);
   if (status != 0) {
@@ -718,6 +954,14 @@ static int mqtt_config_subscriber(oconfig_item_t *ci) {
       cf_util_get_string(child, &conf->topic);
     else if (strcasecmp("CleanSession", child->key) == 0)
       cf_util_get_boolean(child, &conf->clean_session);
+    else if (strcasecmp("BatchSize", child->key) == 0) {
+      int size = 0;
+      status = cf_util_get_int(child, &size);
+      if ((status != 0) || (size < 1))
+        ERROR("mqtt plugin: \"BatchSize\" must be positive.");
+      else
+        conf->batch.size = (size_t)size;
+    }
     else if (strcasecmp("CACert", child->key) == 0)
       cf_util_get_string(child, &conf->cacertificatefile);
     else if (strcasecmp("CertificateFile", child->key) == 0)
@@ -732,6 +976,13 @@ static int mqtt_config_subscriber(oconfig_item_t *ci) {
       ERROR("mqtt plugin: Unknown config option: %s", child->key);
   }
 
+  conf->batch.vls = calloc(conf->batch.size, sizeof(*conf->batch.vls));
+  if (conf->batch.vls == NULL) {
+    ERROR("mqtt plugin: calloc failed.");
+    mqtt_free(conf);
+    return -1;
+  }
+
   tmp = realloc(subscribers, sizeof(*subscribers) * (subscribers_num + 1));
   if (tmp == NULL) {
     ERROR("mqtt plugin: realloc failed.");
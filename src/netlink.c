@@ -31,6 +31,7 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/rtnl/rtnl.h"
 
 #if HAVE_REGEX_H
 #include <regex.h>
@@ -81,13 +82,6 @@ struct ir_link_stats_storage_s {
   uint64_t tx_window_errors;
 };
 
-union ir_link_stats_u {
-  struct rtnl_link_stats *stats32;
-#ifdef HAVE_RTNL_LINK_STATS64
-  struct rtnl_link_stats64 *stats64;
-#endif
-};
-
 #ifdef HAVE_IFLA_VF_STATS
 typedef struct vf_stats_s {
   struct ifla_vf_mac *vf_mac;
@@ -330,27 +324,28 @@ static void submit_two(const char *dev, const char *type,
   plugin_dispatch_values(&vl);
 } /* void submit_two */
 
-static int update_iflist(struct ifinfomsg *msg, const char *dev) {
+static int update_iflist(int ifindex, const char *dev) {
   /* Update the `iflist'. It's used to know which interfaces exist and query
    * them later for qdiscs and classes. */
-  if ((msg->ifi_index >= 0) && ((size_t)msg->ifi_index >= iflist_len)) {
+  if (ifindex < 0)
+    return 0;
+
+  if ((size_t)ifindex >= iflist_len) {
     char **temp;
 
-    temp = realloc(iflist, (msg->ifi_index + 1) * sizeof(char *));
+    temp = realloc(iflist, (ifindex + 1) * sizeof(char *));
     if (temp == NULL) {
       ERROR("netlink plugin: update_iflist: realloc failed.");
       return -1;
     }
 
-    memset(temp + iflist_len, '\0',
-           (msg->ifi_index + 1 - iflist_len) * sizeof(char *));
+    memset(temp + iflist_len, '\0', (ifindex + 1 - iflist_len) * sizeof(char *));
     iflist = temp;
-    iflist_len = msg->ifi_index + 1;
+    iflist_len = ifindex + 1;
   }
-  if ((iflist[msg->ifi_index] == NULL) ||
-      (strcmp(iflist[msg->ifi_index], dev) != 0)) {
-    sfree(iflist[msg->ifi_index]);
-    iflist[msg->ifi_index] = strdup(dev);
+  if ((iflist[ifindex] == NULL) || (strcmp(iflist[ifindex], dev) != 0)) {
+    sfree(iflist[ifindex]);
+    iflist[ifindex] = strdup(dev);
   }
 
   return 0;
@@ -421,8 +416,9 @@ static void check_ignorelist_and_submit(const char *dev,
   COPY_RTNL_LINK_VALUE(dst_stats, src_stats, tx_window_errors)
 
 #ifdef HAVE_RTNL_LINK_STATS64
-static void check_ignorelist_and_submit64(const char *dev,
-                                          struct rtnl_link_stats64 *stats) {
+static void
+check_ignorelist_and_submit64(const char *dev,
+                              struct rtnl_link_stats64 const *stats) {
   struct ir_link_stats_storage_s s;
 
   COPY_RTNL_LINK_STATS(&s, stats);
@@ -435,7 +431,7 @@ static void check_ignorelist_and_submit64(const char *dev,
 #endif
 
 static void check_ignorelist_and_submit32(const char *dev,
-                                          struct rtnl_link_stats *stats) {
+                                          struct rtnl_link_stats const *stats) {
   struct ir_link_stats_storage_s s;
 
   COPY_RTNL_LINK_STATS(&s, stats);
@@ -654,50 +650,24 @@ static int vf_info_attr_cb(const struct nlattr *attr, void *args) {
 } /* int vf_info_attr_cb */
 #endif /* HAVE_IFLA_VF_STATS */
 
-static int link_filter_cb(const struct nlmsghdr *nlh,
+static int link_filter_cb(rtnl_link_t const *link,
                           void *args __attribute__((unused))) {
+  const char *dev = link->name;
+#ifdef HAVE_IFLA_VF_STATS
+  const struct nlmsghdr *nlh = link->nlh;
   struct ifinfomsg *ifm = mnl_nlmsg_get_payload(nlh);
   struct nlattr *attr;
-  const char *dev = NULL;
-  union ir_link_stats_u stats;
-#ifdef HAVE_IFLA_VF_STATS
   uint32_t num_vfs = 0;
 #endif
-  bool stats_done = false;
 
-  if (nlh->nlmsg_type != RTM_NEWLINK) {
-    ERROR("netlink plugin: link_filter_cb: Don't know how to handle type %i.",
-          nlh->nlmsg_type);
-    return MNL_CB_ERROR;
-  }
-
-  /* Scan attribute list for device name. */
-  mnl_attr_for_each(attr, nlh, sizeof(*ifm)) {
-    if (mnl_attr_get_type(attr) != IFLA_IFNAME)
-      continue;
-
-    if (mnl_attr_validate(attr, MNL_TYPE_STRING) < 0) {
-      ERROR("netlink plugin: link_filter_cb: IFLA_IFNAME mnl_attr_validate "
-            "failed.");
-      return MNL_CB_ERROR;
-    }
-
-    dev = mnl_attr_get_str(attr);
-    if (update_iflist(ifm, dev) < 0)
-      return MNL_CB_ERROR;
-    break;
-  }
-
-  if (dev == NULL) {
-    ERROR("netlink plugin: link_filter_cb: dev == NULL");
-    return MNL_CB_ERROR;
-  }
+  if (update_iflist(link->ifindex, dev) < 0)
+    return -1;
 
   if (check_ignorelist(dev, "interface", NULL) != 0 &&
       check_ignorelist(dev, "if_detail", NULL) != 0) {
     DEBUG("netlink plugin: link_filter_cb: Ignoring %s/interface.", dev);
     DEBUG("netlink plugin: link_filter_cb: Ignoring %s/if_detail.", dev);
-    return MNL_CB_OK;
+    return 0;
   }
 
 #ifdef HAVE_IFLA_VF_STATS
@@ -709,7 +679,7 @@ static int link_filter_cb(const struct nlmsghdr *nlh,
       if (mnl_attr_validate(attr, MNL_TYPE_U32) < 0) {
         ERROR("netlink plugin: link_filter_cb: IFLA_NUM_VF mnl_attr_validate "
               "failed.");
-        return MNL_CB_ERROR;
+        return -1;
       }
 
       num_vfs = mnl_attr_get_u32(attr);
@@ -719,52 +689,20 @@ static int link_filter_cb(const struct nlmsghdr *nlh,
 #endif
 
 #ifdef HAVE_RTNL_LINK_STATS64
-  mnl_attr_for_each(attr, nlh, sizeof(*ifm)) {
-    if (mnl_attr_get_type(attr) != IFLA_STATS64)
-      continue;
-
-    uint16_t attr_len = mnl_attr_get_payload_len(attr);
-    if (attr_len < sizeof(*stats.stats64)) {
-      ERROR("netlink plugin: link_filter_cb: IFLA_STATS64 attribute has "
-            "insufficient data.");
-      return MNL_CB_ERROR;
-    }
-    stats.stats64 = mnl_attr_get_payload(attr);
-
-    check_ignorelist_and_submit64(dev, stats.stats64);
-
-    stats_done = true;
-    break;
-  }
+  if (link->stats64 != NULL)
+    check_ignorelist_and_submit64(dev, link->stats64);
+  else
 #endif
-  if (stats_done == false) {
-    mnl_attr_for_each(attr, nlh, sizeof(*ifm)) {
-      if (mnl_attr_get_type(attr) != IFLA_STATS)
-        continue;
-
-      uint16_t attr_len = mnl_attr_get_payload_len(attr);
-      if (attr_len < sizeof(*stats.stats32)) {
-        ERROR("netlink plugin: link_filter_cb: IFLA_STATS attribute has "
-              "insufficient data.");
-        return MNL_CB_ERROR;
-      }
-      stats.stats32 = mnl_attr_get_payload(attr);
-
-      check_ignorelist_and_submit32(dev, stats.stats32);
-
-      stats_done = true;
-      break;
-    }
-  }
-
+      if (link->stats32 != NULL)
+    check_ignorelist_and_submit32(dev, link->stats32);
 #if COLLECT_DEBUG
-  if (stats_done == false)
+  else
     DEBUG("netlink plugin: link_filter: No statistics for interface %s.", dev);
 #endif
 
 #ifdef HAVE_IFLA_VF_STATS
   if (num_vfs == 0)
-    return MNL_CB_OK;
+    return 0;
 
   /* Get VFINFO list. */
   mnl_attr_for_each(attr, nlh, sizeof(*ifm)) {
@@ -774,7 +712,7 @@ static int link_filter_cb(const struct nlmsghdr *nlh,
     if (mnl_attr_validate(attr, MNL_TYPE_NESTED) < 0) {
       ERROR("netlink plugin: link_filter_cb: IFLA_VFINFO_LIST "
             "mnl_attr_validate failed.");
-      return MNL_CB_ERROR;
+      return -1;
     }
 
     struct nlattr *nested;
@@ -786,13 +724,13 @@ static int link_filter_cb(const struct nlmsghdr *nlh,
       if (mnl_attr_validate(nested, MNL_TYPE_NESTED) < 0) {
         ERROR("netlink plugin: link_filter_cb: IFLA_VF_INFO mnl_attr_validate "
               "failed.");
-        return MNL_CB_ERROR;
+        return -1;
       }
 
       vf_stats_t vf_stats = {0};
       if (mnl_attr_parse_nested(nested, vf_info_attr_cb, &vf_stats) ==
           MNL_CB_ERROR)
-        return MNL_CB_ERROR;
+        return -1;
 
       vf_info_submit(dev, &vf_stats);
     }
@@ -800,7 +738,7 @@ static int link_filter_cb(const struct nlmsghdr *nlh,
   }
 #endif
 
-  return MNL_CB_OK;
+  return 0;
 } /* int link_filter_cb */
 
 #if HAVE_TCA_STATS2
@@ -1139,14 +1077,9 @@ static int ir_config(const char *key, const char *value) {
 } /* int ir_config */
 
 static int ir_init(void) {
-  nl = mnl_socket_open(NETLINK_ROUTE);
+  nl = rtnl_open();
   if (nl == NULL) {
-    ERROR("netlink plugin: ir_init: mnl_socket_open failed.");
-    return -1;
-  }
-
-  if (mnl_socket_bind(nl, 0, MNL_SOCKET_AUTOPID) < 0) {
-    ERROR("netlink plugin: ir_init: mnl_socket_bind failed.");
+    ERROR("netlink plugin: ir_init: rtnl_open failed.");
     return -1;
   }
 
@@ -1159,7 +1092,6 @@ static int ir_init(void) {
 static int ir_read(void) {
   char buf[nl_socket_buffer_size];
   struct nlmsghdr *nlh;
-  struct rtgenmsg *rt;
   int ret;
   unsigned int seq, portid;
 
@@ -1168,39 +1100,18 @@ static int ir_read(void) {
 
   portid = mnl_socket_get_portid(nl);
 
-  nlh = mnl_nlmsg_put_header(buf);
-  nlh->nlmsg_type = RTM_GETLINK;
-  nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
-  nlh->nlmsg_seq = seq = time(NULL);
-  rt = mnl_nlmsg_put_extra_header(nlh, sizeof(*rt));
-  rt->rtgen_family = AF_PACKET;
-
+  uint32_t ext_mask = 0;
 #ifdef HAVE_IFLA_VF_STATS
-  if (collect_vf_stats &&
-      mnl_attr_put_u32_check(nlh, sizeof(buf), IFLA_EXT_MASK,
-                             RTEXT_FILTER_VF) == 0) {
-    ERROR("netlink plugin: FAILED to set RTEXT_FILTER_VF");
-    return -1;
-  }
+  if (collect_vf_stats)
+    ext_mask = RTEXT_FILTER_VF;
 #endif
 
-  if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0) {
-    ERROR("netlink plugin: ir_read: rtnl_wilddump_request failed.");
+  if (rtnl_link_dump(nl, buf, sizeof(buf), ext_mask, link_filter_cb, NULL) !=
+      0) {
+    ERROR("netlink plugin: ir_read: rtnl_link_dump failed.");
     return -1;
   }
 
-  ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
-  while (ret > 0) {
-    ret = mnl_cb_run(buf, ret, seq, portid, link_filter_cb, NULL);
-    if (ret <= MNL_CB_STOP)
-      break;
-    ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
-  }
-  if (ret < 0) {
-    ERROR("netlink plugin: ir_read: mnl_socket_recvfrom failed: %s", STRERRNO);
-    return (-1);
-  }
-
   /* `link_filter_cb' will update `iflist' which is used here to iterate
    * over all interfaces. */
   for (size_t ifindex = 1; ifindex < iflist_len; ifindex++) {
@@ -24,10 +24,13 @@
 
 #define _DEFAULT_SOURCE
 #define _BSD_SOURCE /* For struct ip_mreq */
+#define _GNU_SOURCE /* For recvmmsg */
 
 #include "collectd.h"
 
 #include "plugin.h"
+#include "probes.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 #include "utils_cache.h"
 #include "utils_complain.h"
@@ -41,6 +44,9 @@
 #if HAVE_NETINET_IN_H
 #include <netinet/in.h>
 #endif
+#if HAVE_NETINET_TCP_H
+#include <netinet/tcp.h>
+#endif
 #if HAVE_ARPA_INET_H
 #include <arpa/inet.h>
 #endif
@@ -50,6 +56,9 @@
 #if HAVE_NET_IF_H
 #include <net/if.h>
 #endif
+#if HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
 
 #if HAVE_GCRYPT_H
 #if defined __APPLE__
@@ -74,6 +83,10 @@ GCRY_THREAD_OPTION_PTHREAD_IMPL;
 #endif
 #endif
 
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 #ifndef IPV6_ADD_MEMBERSHIP
 #ifdef IPV6_JOIN_GROUP
 #define IPV6_ADD_MEMBERSHIP IPV6_JOIN_GROUP
@@ -92,6 +105,23 @@ GCRY_THREAD_OPTION_PTHREAD_IMPL;
  */
 #define BUFF_SIG_SIZE 106
 
+/* Largest run of parts a compressed part may expand to. Larger ones are
+ * discarded, so that a small packet cannot make us allocate lots of memory. */
+#define COMPR_INFLATE_MAX 65536
+
+/* On stream (TCP) sockets, every packet is sent as a frame: the packet's size
+ * as a 32 bit integer in network byte order, followed by the packet. */
+#define STREAM_FRAME_HEADER_SIZE 4
+/* Size of the buffer in which frames to a server are coalesced. */
+#define STREAM_BUFFER_SIZE 65536
+/* Seconds until a write to a stuck server fails. */
+#define STREAM_SEND_TIMEOUT 5
+/* Bytes read from a connection at once. */
+#define STREAM_READ_SIZE 65536
+/* Receivers stop reading from their connections while more packets than
+ * this wait for the dispatch thread. */
+#define STREAM_QUEUE_MAX 8192
+
 /*
  * Private data types
  */
@@ -100,6 +130,9 @@ GCRY_THREAD_OPTION_PTHREAD_IMPL;
 #define SECURITY_LEVEL_SIGN 1
 #define SECURITY_LEVEL_ENCRYPT 2
 #endif
+/* State of a stream (TCP) server, see stream_client_thread(). */
+struct stream_client_s;
+
 struct sockent_client {
   int fd;
   struct sockaddr_storage *addr;
@@ -114,23 +147,53 @@ struct sockent_client {
   cdtime_t next_resolve_reconnect;
   cdtime_t resolve_interval;
   struct sockaddr_storage *bind_addr;
+  /* Send the value lists in TYPE_COMPR_ZLIB parts. */
+  bool compress;
+  /* Only used for SOCK_STREAM sockets. */
+  struct stream_client_s *stream;
+};
+
+#if HAVE_GCRYPT_H
+/* Handles keyed with one user's secret. Server sockets cache them, so that
+ * neither the password file is consulted nor are keys derived per packet. */
+struct server_user {
+  /* Generation of `userdb' the secret was read from. */
+  uint64_t generation;
+  gcry_md_hd_t hmac;
+  gcry_cipher_hd_t cypher;
 };
+#endif
 
 struct sockent_server {
   int *fd;
   size_t fd_num;
+  /* Index of the receiver handling this socket, see receiver_t. */
+  size_t receiver;
 #if HAVE_GCRYPT_H
   int security_level;
   char *auth_file;
   fbhash_t *userdb;
-  gcry_cipher_hd_t cypher;
+  /* username -> struct server_user. Only used by the receiver's dispatch
+   * thread, so the handles need no locking. */
+  c_avl_tree_t *users;
 #endif
+#if HAVE_ZLIB
+  /* Created when the first compressed part arrives. Like `users', only used
+   * by the receiver's dispatch thread. */
+  z_stream *zstream;
+  char *inflate_buffer;
+#endif
+  /* Number of value lists parsed, used for the per-sender statistics. Only
+   * updated by the receiver's dispatch thread. */
+  uint64_t values_num;
 };
 
 typedef struct sockent {
 #define SOCKENT_TYPE_CLIENT 1
 #define SOCKENT_TYPE_SERVER 2
   int type;
+  /* SOCK_DGRAM (UDP) or SOCK_STREAM (TCP) */
+  int socktype;
 
   char *node;
   char *service;
@@ -145,6 +208,22 @@ typedef struct sockent {
   pthread_mutex_t lock;
 } sockent_t;
 
+/* Write threads append frames to `buffer' while the stream thread writes
+ * `out' to the server. Frames arriving during a write are sent with the next
+ * one, so that the number of writes drops as the load increases. All members
+ * are protected by the sockent's lock. */
+struct stream_client_s {
+  char *buffer;
+  size_t fill;
+  char *out;
+  /* Signaled when frames are added and when room becomes available. */
+  pthread_cond_t cond;
+  bool connected;
+  bool stop;
+  bool thread_running;
+  pthread_t thread_id;
+};
+
 /*                      1 1 1 1 1 1 1 1 1 1 2 2 2 2 2 2 2 2 2 2 3 3
  *  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
  * +-------+-----------------------+-------------------------------+
@@ -255,12 +334,80 @@ typedef struct part_encryption_aes256_s part_encryption_aes256_t;
 struct receive_list_entry_s {
   char *data;
   int data_len;
+  /* The listen socket, also for packets received on a connection. */
   int fd;
   struct sockaddr_storage sender;
   struct receive_list_entry_s *next;
 };
 typedef struct receive_list_entry_s receive_list_entry_t;
 
+/* Maximum number of packets received with one recvmmsg(2) call. */
+#define RECEIVE_BATCH_SIZE 64
+/* Maximum number of unused receive list entries kept for reuse. */
+#define RECEIVE_FREE_LIST_MAX 4096
+
+/* A connection accepted on a stream listen socket, or the listen socket
+ * itself. */
+struct stream_conn_s {
+  int fd;
+  int listen_fd;
+  struct sockaddr_storage sender;
+  /* An incomplete frame, including its header. */
+  char *buffer;
+  size_t fill;
+  struct stream_conn_s *prev;
+  struct stream_conn_s *next;
+};
+typedef struct stream_conn_s stream_conn_t;
+
+/* Every receiver has a receive thread, a dispatch thread and its own copy of
+ * each listen socket. With more than one receiver the copies are bound with
+ * SO_REUSEPORT, so that the kernel spreads the incoming flows over them.
+ * Stream listen sockets and their connections are handled by another thread
+ * using epoll(7), see network_receive_stream(). */
+struct receiver_s {
+  struct pollfd *pollfd;
+  size_t pollfd_num;
+
+  size_t stream_listen_num;
+  stream_conn_t *stream_conns;
+  bool stream_thread_running;
+  pthread_t stream_thread_id;
+
+  receive_list_entry_t *list_head;
+  receive_list_entry_t *list_tail;
+  pthread_mutex_t list_lock;
+  pthread_cond_t list_cond;
+  uint64_t list_length;
+
+  bool receive_thread_running;
+  pthread_t receive_thread_id;
+  bool dispatch_thread_running;
+  pthread_t dispatch_thread_id;
+};
+typedef struct receiver_s receiver_t;
+
+/* What to do when a receive queue is full, see "ReceiveQueueLimit". */
+#define RECEIVE_QUEUE_DROP_NEWEST 0
+#define RECEIVE_QUEUE_DROP_OLDEST 1
+
+/* Per source address statistics, reported with "ReportStats". The port is
+ * ignored, so that senders using many source ports are counted once. */
+struct sender_stats_s {
+  sa_family_t family;
+  uint8_t addr[16];
+  uint64_t packets;
+  uint64_t values;
+  uint64_t dropped;
+  struct sender_stats_s *next;
+};
+typedef struct sender_stats_s sender_stats_t;
+
+#define SENDER_STATS_BUCKETS 256
+/* Senders beyond this number are not tracked, so that spoofed source
+ * addresses can't exhaust the memory. */
+#define SENDER_STATS_MAX 1024
+
 /*
  * Private variables
  */
@@ -268,42 +415,140 @@ static int network_config_ttl;
 /* Ethernet - (IPv6 + UDP) = 1500 - (40 + 8) = 1452 */
 static size_t network_config_packet_size = 1452;
 static bool network_config_forward;
+/* Forward received packets without parsing them, parsing only every
+ * `network_config_relay_sample'th packet locally (never if zero). */
+static bool network_config_relay;
+static int network_config_relay_sample;
+/* Send packets at a fixed, host specific offset into the interval and at most
+ * `network_config_send_rate' packets per second, see send_pace_thread(). */
+static bool network_config_send_spread;
+static double network_config_send_rate;
+static int network_config_send_burst = 10;
 static bool network_config_stats;
+static size_t network_config_receive_threads = 1;
+static size_t network_config_reorder_window;
+/* Memory budget of all receive queues in bytes, zero for no limit. */
+static uint64_t network_config_receive_queue_limit;
+static int network_config_receive_queue_policy = RECEIVE_QUEUE_DROP_NEWEST;
+/* Maximum number of packets in each receiver's queue, derived from the budget
+ * in network_init(). */
+static uint64_t receive_queue_max;
 
 static sockent_t *sending_sockets;
+/* Number of servers with and without the "Compress" option. */
+static size_t sending_sockets_compressed_num;
+static size_t sending_sockets_plain_num;
+
+static receiver_t *receivers;
+static size_t receivers_num;
 
-static receive_list_entry_t *receive_list_head;
-static receive_list_entry_t *receive_list_tail;
-static pthread_mutex_t receive_list_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t receive_list_cond = PTHREAD_COND_INITIALIZER;
-static uint64_t receive_list_length;
+/* Entries the dispatch thread is done with. The receive thread reuses them,
+ * so that packets can be received without allocating memory. */
+static receive_list_entry_t *receive_free_list;
+static size_t receive_free_list_num;
+static pthread_mutex_t receive_free_list_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static sockent_t *listen_sockets;
-static struct pollfd *listen_sockets_pollfd;
-static size_t listen_sockets_num;
+
+/* Packets waiting for the pacing thread. */
+#define SEND_PACE_QUEUE_MAX 4096
+struct send_paced_s;
+typedef struct send_paced_s send_paced_t;
+struct send_paced_s {
+  send_paced_t *next;
+  cdtime_t due;
+  int dest;
+  size_t len;
+  char data[];
+};
+static send_paced_t *send_pace_head;
+static send_paced_t *send_pace_tail;
+static size_t send_pace_num;
+static pthread_mutex_t send_pace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t send_pace_cond = PTHREAD_COND_INITIALIZER;
+static bool send_pace_stop;
+static bool send_pace_thread_running;
+static pthread_t send_pace_thread_id;
+static cdtime_t send_pace_interval;
+static cdtime_t send_pace_offset;
+
+static sender_stats_t *sender_stats[SENDER_STATS_BUCKETS];
+static size_t sender_stats_num;
+static pthread_mutex_t sender_stats_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /* The receive and dispatch threads will run as long as `listen_loop' is set to
  * zero. */
 static int listen_loop;
-static int receive_thread_running;
-static pthread_t receive_thread_id;
-static int dispatch_thread_running;
-static pthread_t dispatch_thread_id;
-
-/* Buffer in which to-be-sent network packets are constructed. */
-static char *send_buffer;
-static char *send_buffer_ptr;
-static int send_buffer_fill;
-static cdtime_t send_buffer_last_update;
-static value_list_t send_buffer_vl = VALUE_LIST_INIT;
-static pthread_mutex_t send_buffer_lock = PTHREAD_MUTEX_INITIALIZER;
-
-/* XXX: These counters are incremented from one place only. The spot in which
- * the values are incremented is either only reachable by one thread (the
- * dispatch thread, for example) or locked by some lock (send_buffer_lock for
- * example). Only if neither is true, the stats_lock is acquired. The counters
- * are always read without holding a lock in the hope that writing 8 bytes to
- * memory is an atomic operation. */
+
+#if HAVE_ZLIB
+/* Compressed packet for the servers with the "Compress" option. New parts are
+ * collected in `pending' and only compressed with a sync flush once the next
+ * value list might not fit into the packet uncompressed. The sync flush keeps
+ * the dictionary, so later parts still refer back to earlier ones and nothing
+ * is compressed twice. */
+struct send_zbuffer_s {
+  z_stream stream;
+  /* TYPE_COMPR_ZLIB part header, followed by the deflate output. */
+  char *packet;
+  char *pending;
+  size_t pending_fill;
+  value_list_t vl;
+};
+typedef struct send_zbuffer_s send_zbuffer_t;
+
+/* Worst case size of the zlib header and trailer, and the overhead added to a
+ * run of parts compressed with a sync flush, i.e. the size of the blocks'
+ * headers. These are used to make sure the packet never overflows. */
+#define COMPR_STREAM_OVERHEAD 8
+#define COMPR_FLUSH_OVERHEAD 16
+#endif
+
+/* A value list waiting in the reorder window, see "ReorderWindow". */
+struct send_window_entry_s {
+  const data_set_t *ds;
+  value_list_t vl;
+  value_t *values;
+  size_t values_size;
+};
+typedef struct send_window_entry_s send_window_entry_t;
+
+/* Buffer in which to-be-sent network packets are constructed. Every write
+ * thread fills its own buffer, so that the threads don't serialize on a single
+ * lock. The lock of a buffer is only contended by flushes. */
+struct send_buffer_s {
+  char *buffer;
+  char *ptr;
+  int fill;
+  cdtime_t last_update;
+  value_list_t vl;
+#if HAVE_ZLIB
+  /* Only allocated if a server has the "Compress" option. */
+  send_zbuffer_t *zb;
+#endif
+  /* Value lists collected with "ReorderWindow". They are sorted by identifier
+   * before being added to the packets, so that runs of value lists with the
+   * same host, plugin and type share these parts. */
+  send_window_entry_t *window;
+  send_window_entry_t **window_sorted;
+  size_t window_num;
+  pthread_mutex_t lock;
+  struct send_buffer_s *next;
+};
+typedef struct send_buffer_s send_buffer_t;
+
+/* Selects the servers a packet is sent to, see network_send_buffer(). */
+#define SEND_TO_ALL 0
+#define SEND_TO_PLAIN 1
+#define SEND_TO_COMPRESSED 2
+
+static pthread_key_t send_buffer_key;
+static send_buffer_t *send_buffers;
+static pthread_mutex_t send_buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* XXX: These counters are updated by the possibly many receive, dispatch and
+ * write threads, so they are incremented atomically. They are read without
+ * holding a lock in the hope that reading 8 bytes from memory is an atomic
+ * operation. */
 static derive_t stats_octets_rx;
 static derive_t stats_octets_tx;
 static derive_t stats_packets_rx;
@@ -312,7 +557,7 @@ static derive_t stats_values_dispatched;
 static derive_t stats_values_not_dispatched;
 static derive_t stats_values_sent;
 static derive_t stats_values_not_sent;
-static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static derive_t stats_packets_dropped;
 
 /*
  * Private functions
@@ -337,7 +582,8 @@ static bool check_send_okay(const value_list_t *vl) /* {{{ */
   bool received = 0;
   int status;
 
-  if (network_config_forward)
+  /* Received values have been relayed already, see PP_RELAY. */
+  if (network_config_forward && !network_config_relay)
     return 1;
 
   if (vl->meta == NULL)
@@ -393,51 +639,33 @@ static bool check_send_notify_okay(const notification_t *n) /* {{{ */
   return !received;
 } /* }}} bool check_send_notify_okay */
 
-static int network_dispatch_values(value_list_t *vl, /* {{{ */
-                                   const char *username,
-                                   struct sockaddr_storage *address) {
+/* Creates the meta data attached to the value lists received in one packet.
+ * It only depends on the sender, so it's created once per packet and shared by
+ * all of its value lists. plugin_dispatch_values() copies it when queueing. */
+static meta_data_t *network_received_meta(const char *username, /* {{{ */
+                                          struct sockaddr_storage *address) {
+  meta_data_t *meta;
   int status;
 
-  if ((vl->time == 0) || (strlen(vl->host) == 0) || (strlen(vl->plugin) == 0) ||
-      (strlen(vl->type) == 0))
-    return -EINVAL;
-
-  if (!check_receive_okay(vl)) {
-#if COLLECT_DEBUG
-    char name[6 * DATA_MAX_NAME_LEN];
-    FORMAT_VL(name, sizeof(name), vl);
-    name[sizeof(name) - 1] = '\0';
-    DEBUG("network plugin: network_dispatch_values: "
-          "NOT dispatching %s.",
-          name);
-#endif
-    stats_values_not_dispatched++;
-    return 0;
-  }
-
-  assert(vl->meta == NULL);
-
-  vl->meta = meta_data_create();
-  if (vl->meta == NULL) {
+  meta = meta_data_create();
+  if (meta == NULL) {
     ERROR("network plugin: meta_data_create failed.");
-    return -ENOMEM;
+    return NULL;
   }
 
-  status = meta_data_add_boolean(vl->meta, "network:received", 1);
+  status = meta_data_add_boolean(meta, "network:received", 1);
   if (status != 0) {
     ERROR("network plugin: meta_data_add_boolean failed.");
-    meta_data_destroy(vl->meta);
-    vl->meta = NULL;
-    return status;
+    meta_data_destroy(meta);
+    return NULL;
   }
 
   if (username != NULL) {
-    status = meta_data_add_string(vl->meta, "network:username", username);
+    status = meta_data_add_string(meta, "network:username", username);
     if (status != 0) {
       ERROR("network plugin: meta_data_add_string failed.");
-      meta_data_destroy(vl->meta);
-      vl->meta = NULL;
-      return status;
+      meta_data_destroy(meta);
+      return NULL;
     }
   }
 
@@ -448,24 +676,54 @@ static int network_dispatch_values(value_list_t *vl, /* {{{ */
                          NULL, 0, NI_NUMERICHOST | NI_NUMERICSERV);
     if (status != 0) {
       ERROR("network plugin: getnameinfo failed: %s", gai_strerror(status));
-      meta_data_destroy(vl->meta);
-      vl->meta = NULL;
-      return status;
+      meta_data_destroy(meta);
+      return NULL;
     }
 
-    status = meta_data_add_string(vl->meta, "network:ip_address", host);
+    status = meta_data_add_string(meta, "network:ip_address", host);
     if (status != 0) {
       ERROR("network plugin: meta_data_add_string failed.");
-      meta_data_destroy(vl->meta);
-      vl->meta = NULL;
-      return status;
+      meta_data_destroy(meta);
+      return NULL;
     }
   }
 
-  plugin_dispatch_values(vl);
-  stats_values_dispatched++;
+  return meta;
+} /* }}} meta_data_t *network_received_meta */
+
+/* Dispatches `vl' with the packet's meta data, which is created in `*meta' by
+ * the first call for each packet. The caller must destroy it. */
+static int network_dispatch_values(value_list_t *vl, /* {{{ */
+                                   meta_data_t **meta, const char *username,
+                                   struct sockaddr_storage *address) {
+  if ((vl->time == 0) || (strlen(vl->host) == 0) || (strlen(vl->plugin) == 0) ||
+      (strlen(vl->type) == 0))
+    return -EINVAL;
+
+  if (!check_receive_okay(vl)) {
+#if COLLECT_DEBUG
+    char name[6 * DATA_MAX_NAME_LEN];
+    FORMAT_VL(name, sizeof(name), vl);
+    name[sizeof(name) - 1] = '\0';
+    DEBUG("network plugin: network_dispatch_values: "
+          "NOT dispatching %s.",
+          name);
+#endif
+    __atomic_fetch_add(&stats_values_not_dispatched, 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+
+  assert(vl->meta == NULL);
+
+  if (*meta == NULL) {
+    *meta = network_received_meta(username, address);
+    if (*meta == NULL)
+      return -ENOMEM;
+  }
 
-  meta_data_destroy(vl->meta);
+  vl->meta = *meta;
+  plugin_dispatch_values(vl);
+  __atomic_fetch_add(&stats_values_dispatched, 1, __ATOMIC_RELAXED);
   vl->meta = NULL;
 
   return 0;
@@ -533,6 +791,129 @@ static int network_init_gcrypt(void) /* {{{ */
   return 0;
 } /* }}} int network_init_gcrypt */
 
+static void server_user_destroy(struct server_user *u) /* {{{ */
+{
+  if (u == NULL)
+    return;
+
+  if (u->hmac != NULL)
+    gcry_md_close(u->hmac);
+  if (u->cypher != NULL)
+    gcry_cipher_close(u->cypher);
+  sfree(u);
+} /* }}} void server_user_destroy */
+
+static struct server_user *server_user_create(const char *secret) /* {{{ */
+{
+  struct server_user *u;
+  unsigned char password_hash[32];
+  gcry_error_t err;
+
+  u = calloc(1, sizeof(*u));
+  if (u == NULL)
+    return NULL;
+
+  err = gcry_md_open(&u->hmac, GCRY_MD_SHA256, GCRY_MD_FLAG_HMAC);
+  if (err != 0) {
+    ERROR("network plugin: Creating HMAC-SHA-256 object failed: %s",
+          gcry_strerror(err));
+    u->hmac = NULL;
+    server_user_destroy(u);
+    return NULL;
+  }
+
+  err = gcry_md_setkey(u->hmac, secret, strlen(secret));
+  if (err != 0) {
+    ERROR("network plugin: gcry_md_setkey failed: %s", gcry_strerror(err));
+    server_user_destroy(u);
+    return NULL;
+  }
+
+  err = gcry_cipher_open(&u->cypher, GCRY_CIPHER_AES256, GCRY_CIPHER_MODE_OFB,
+                         /* flags = */ 0);
+  if (err != 0) {
+    ERROR("network plugin: gcry_cipher_open returned: %s", gcry_strerror(err));
+    u->cypher = NULL;
+    server_user_destroy(u);
+    return NULL;
+  }
+
+  gcry_md_hash_buffer(GCRY_MD_SHA256, password_hash, secret, strlen(secret));
+  err = gcry_cipher_setkey(u->cypher, password_hash, sizeof(password_hash));
+  if (err != 0) {
+    ERROR("network plugin: gcry_cipher_setkey returned: %s",
+          gcry_strerror(err));
+    server_user_destroy(u);
+    return NULL;
+  }
+
+  return u;
+} /* }}} struct server_user *server_user_create */
+
+static void server_users_destroy(c_avl_tree_t *users) /* {{{ */
+{
+  char *username;
+  struct server_user *u;
+
+  if (users == NULL)
+    return;
+
+  while (c_avl_pick(users, (void *)&username, (void *)&u) == 0) {
+    sfree(username);
+    server_user_destroy(u);
+  }
+  c_avl_destroy(users);
+} /* }}} void server_users_destroy */
+
+/* Returns the cached handles of `username', creating them if the user is new
+ * or the password file has changed. Returns NULL if the user is unknown. */
+static struct server_user *sockent_server_user(sockent_t *se, /* {{{ */
+                                               const char *username) {
+  struct sockent_server *ses = &se->data.server;
+  struct server_user *u = NULL;
+  uint64_t generation;
+
+  if ((username == NULL) || (ses->userdb == NULL))
+    return NULL;
+
+  if (ses->users == NULL) {
+    ses->users = c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (ses->users == NULL)
+      return NULL;
+  }
+
+  generation = fbh_generation(ses->userdb);
+  if (c_avl_get(ses->users, username, (void *)&u) == 0) {
+    if (u->generation == generation)
+      return u;
+
+    /* The password file has been re-read. */
+    char *key = NULL;
+    c_avl_remove(ses->users, username, (void *)&key, (void *)&u);
+    sfree(key);
+    server_user_destroy(u);
+  }
+
+  char *secret = fbh_get(ses->userdb, username);
+  if (secret == NULL)
+    return NULL;
+
+  u = server_user_create(secret);
+  sfree(secret);
+  if (u == NULL)
+    return NULL;
+  u->generation = generation;
+
+  char *key = strdup(username);
+  if ((key == NULL) || (c_avl_insert(ses->users, key, u) != 0)) {
+    sfree(key);
+    server_user_destroy(u);
+    return NULL;
+  }
+
+  return u;
+} /* }}} struct server_user *sockent_server_user */
+
 static gcry_cipher_hd_t network_get_aes256_cypher(sockent_t *se, /* {{{ */
                                                   const void *iv,
                                                   size_t iv_size,
@@ -541,26 +922,27 @@ static gcry_cipher_hd_t network_get_aes256_cypher(sockent_t *se, /* {{{ */
   gcry_cipher_hd_t *cyper_ptr;
   unsigned char password_hash[32];
 
-  if (se->type == SOCKENT_TYPE_CLIENT) {
-    cyper_ptr = &se->data.client.cypher;
-    memcpy(password_hash, se->data.client.password_hash, sizeof(password_hash));
-  } else {
-    char *secret;
-
-    cyper_ptr = &se->data.server.cypher;
-
-    if (username == NULL)
+  if (se->type == SOCKENT_TYPE_SERVER) {
+    /* The cached cipher is already keyed, only the IV is new. */
+    struct server_user *u = sockent_server_user(se, username);
+    if (u == NULL)
       return NULL;
 
-    secret = fbh_get(se->data.server.userdb, username);
-    if (secret == NULL)
+    gcry_cipher_reset(u->cypher);
+    err = gcry_cipher_setiv(u->cypher, iv, iv_size);
+    if (err != 0) {
+      ERROR("network plugin: gcry_cipher_setiv returned: %s",
+            gcry_strerror(err));
       return NULL;
+    }
 
-    gcry_md_hash_buffer(GCRY_MD_SHA256, password_hash, secret, strlen(secret));
-
-    sfree(secret);
+    return u->cypher;
   }
 
+  cyper_ptr = &se->data.client.cypher;
+  memcpy(password_hash, se->data.client.password_hash, sizeof(password_hash));
+
+  /* The client's key never changes, so the cipher is keyed only once. */
   if (*cyper_ptr == NULL) {
     err = gcry_cipher_open(cyper_ptr, GCRY_CIPHER_AES256, GCRY_CIPHER_MODE_OFB,
                            /* flags = */ 0);
@@ -570,20 +952,20 @@ static gcry_cipher_hd_t network_get_aes256_cypher(sockent_t *se, /* {{{ */
       *cyper_ptr = NULL;
       return NULL;
     }
+
+    err = gcry_cipher_setkey(*cyper_ptr, password_hash, sizeof(password_hash));
+    if (err != 0) {
+      ERROR("network plugin: gcry_cipher_setkey returned: %s",
+            gcry_strerror(err));
+      gcry_cipher_close(*cyper_ptr);
+      *cyper_ptr = NULL;
+      return NULL;
+    }
   } else {
     gcry_cipher_reset(*cyper_ptr);
   }
   assert(*cyper_ptr != NULL);
 
-  err = gcry_cipher_setkey(*cyper_ptr, password_hash, sizeof(password_hash));
-  if (err != 0) {
-    ERROR("network plugin: gcry_cipher_setkey returned: %s",
-          gcry_strerror(err));
-    gcry_cipher_close(*cyper_ptr);
-    *cyper_ptr = NULL;
-    return NULL;
-  }
-
   err = gcry_cipher_setiv(*cyper_ptr, iv, iv_size);
   if (err != 0) {
     ERROR("network plugin: gcry_cipher_setkey returned: %s",
@@ -761,8 +1143,12 @@ static int write_part_string(char **ret_buffer, size_t *ret_buffer_len,
   return 0;
 } /* int write_part_string */
 
+/* Decodes a values part into `*values', growing it as needed. The types are
+ * read directly from the packet and the buffer is reused for all values parts
+ * of a packet. */
 static int parse_part_values(void **ret_buffer, size_t *ret_buffer_len,
-                             value_t **ret_values, size_t *ret_num_values) {
+                             value_t **values, size_t *values_size,
+                             size_t *ret_num_values) {
   char *buffer = *ret_buffer;
   size_t buffer_len = *ret_buffer_len;
 
@@ -773,7 +1159,7 @@ static int parse_part_values(void **ret_buffer, size_t *ret_buffer_len,
   uint16_t pkg_type;
   size_t pkg_numval;
 
-  uint8_t *pkg_types;
+  uint8_t const *pkg_types;
   value_t *pkg_values;
 
   if (buffer_len < 15) {
@@ -816,17 +1202,20 @@ static int parse_part_values(void **ret_buffer, size_t *ret_buffer_len,
     return -1;
   }
 
-  pkg_types = calloc(pkg_numval, sizeof(*pkg_types));
-  pkg_values = calloc(pkg_numval, sizeof(*pkg_values));
-  if ((pkg_types == NULL) || (pkg_values == NULL)) {
-    sfree(pkg_types);
-    sfree(pkg_values);
-    ERROR("network plugin: parse_part_values: calloc failed.");
-    return -1;
+  if (*values_size < pkg_numval) {
+    pkg_values = realloc(*values, pkg_numval * sizeof(*pkg_values));
+    if (pkg_values == NULL) {
+      ERROR("network plugin: parse_part_values: realloc failed.");
+      return -1;
+    }
+    *values = pkg_values;
+    *values_size = pkg_numval;
   }
+  pkg_values = *values;
 
-  memcpy(pkg_types, buffer, pkg_numval * sizeof(*pkg_types));
+  pkg_types = (uint8_t const *)buffer;
   buffer += pkg_numval * sizeof(*pkg_types);
+  /* The values aren't aligned within the packet. */
   memcpy(pkg_values, buffer, pkg_numval * sizeof(*pkg_values));
   buffer += pkg_numval * sizeof(*pkg_values);
 
@@ -852,8 +1241,6 @@ static int parse_part_values(void **ret_buffer, size_t *ret_buffer_len,
       NOTICE("network plugin: parse_part_values: "
              "Don't know how to handle data source type %" PRIu8,
              pkg_types[i]);
-      sfree(pkg_types);
-      sfree(pkg_values);
       return -1;
     } /* switch (pkg_types[i]) */
   }
@@ -861,9 +1248,6 @@ static int parse_part_values(void **ret_buffer, size_t *ret_buffer_len,
   *ret_buffer = buffer;
   *ret_buffer_len = buffer_len - pkg_length;
   *ret_num_values = pkg_numval;
-  *ret_values = pkg_values;
-
-  sfree(pkg_types);
 
   return 0;
 } /* int parse_part_values */
@@ -990,13 +1374,19 @@ static int parse_part_string(void **ret_buffer, size_t *ret_buffer_len,
   return 0;
 } /* int parse_part_string */
 
-/* Forward declaration: parse_part_sign_sha256 and parse_part_encr_aes256 call
- * parse_packet and vice versa. */
+/* Forward declaration: parse_part_sign_sha256, parse_part_encr_aes256 and
+ * parse_part_compr_zlib call parse_packet and vice versa. */
 #define PP_SIGNED 0x01
 #define PP_ENCRYPTED 0x02
+#define PP_COMPRESSED 0x04
+/* Relay the parts that passed the security checks instead of parsing them. */
+#define PP_RELAY 0x08
+/* Parse the relayed parts, too. */
+#define PP_SAMPLE 0x10
 static int parse_packet(sockent_t *se, void *buffer, size_t buffer_size,
                         int flags, const char *username,
                         struct sockaddr_storage *sender);
+static void network_send_buffer(char *buffer, size_t buffer_len, int dest);
 
 #define BUFFER_READ(p, s)                                                      \
   do {                                                                         \
@@ -1015,14 +1405,12 @@ static int parse_part_sign_sha256(sockent_t *se, /* {{{ */
   size_t buffer_offset;
 
   size_t username_len;
-  char *secret;
+  struct server_user *u;
 
   part_signature_sha256_t pss;
   uint16_t pss_head_length;
   char hash[sizeof(pss.hash)];
 
-  gcry_md_hd_t hd;
-  gcry_error_t err;
   unsigned char *hash_ptr;
 
   buffer = *ret_buffer;
@@ -1072,50 +1460,25 @@ static int parse_part_sign_sha256(sockent_t *se, /* {{{ */
 
   assert(buffer_offset == pss_head_length);
 
-  /* Query the password */
-  secret = fbh_get(se->data.server.userdb, pss.username);
-  if (secret == NULL) {
+  /* Get the user's HMAC handle, which is keyed with the password already */
+  u = sockent_server_user(se, pss.username);
+  if (u == NULL) {
     ERROR("network plugin: Unknown user: %s", pss.username);
     sfree(pss.username);
     return -ENOENT;
   }
 
-  /* Create a hash device and check the HMAC */
-  hd = NULL;
-  err = gcry_md_open(&hd, GCRY_MD_SHA256, GCRY_MD_FLAG_HMAC);
-  if (err != 0) {
-    ERROR("network plugin: Creating HMAC-SHA-256 object failed: %s",
-          gcry_strerror(err));
-    sfree(secret);
-    sfree(pss.username);
-    return -1;
-  }
-
-  err = gcry_md_setkey(hd, secret, strlen(secret));
-  if (err != 0) {
-    ERROR("network plugin: gcry_md_setkey failed: %s", gcry_strerror(err));
-    gcry_md_close(hd);
-    sfree(secret);
-    sfree(pss.username);
-    return -1;
-  }
-
-  gcry_md_write(hd, buffer + PART_SIGNATURE_SHA256_SIZE,
+  gcry_md_reset(u->hmac);
+  gcry_md_write(u->hmac, buffer + PART_SIGNATURE_SHA256_SIZE,
                 buffer_len - PART_SIGNATURE_SHA256_SIZE);
-  hash_ptr = gcry_md_read(hd, GCRY_MD_SHA256);
+  hash_ptr = gcry_md_read(u->hmac, GCRY_MD_SHA256);
   if (hash_ptr == NULL) {
     ERROR("network plugin: gcry_md_read failed.");
-    gcry_md_close(hd);
-    sfree(secret);
     sfree(pss.username);
     return -1;
   }
   memcpy(hash, hash_ptr, sizeof(hash));
 
-  /* Clean up */
-  gcry_md_close(hd);
-  hd = NULL;
-
   if (memcmp(pss.hash, hash, sizeof(pss.hash)) != 0) {
     WARNING("network plugin: Verifying HMAC-SHA-256 signature failed: "
             "Hash mismatch. Username: %s",
@@ -1125,7 +1488,6 @@ static int parse_part_sign_sha256(sockent_t *se, /* {{{ */
                  flags | PP_SIGNED, pss.username, sender);
   }
 
-  sfree(secret);
   sfree(pss.username);
 
   *ret_buffer = buffer + buffer_len;
@@ -1334,6 +1696,97 @@ static int parse_part_encr_aes256(sockent_t *se, /* {{{ */
 } /* }}} int parse_part_encr_aes256 */
 #endif /* !HAVE_GCRYPT_H */
 
+static int parse_part_compr_zlib(sockent_t *se, /* {{{ */
+                                 void **ret_buffer, size_t *ret_buffer_size,
+                                 int flags, const char *username,
+                                 struct sockaddr_storage *sender) {
+  char *buffer = *ret_buffer;
+  size_t buffer_size = *ret_buffer_size;
+  size_t buffer_offset = 0;
+
+  part_header_t ph;
+  size_t ph_length;
+
+  /* parse_packet assures this minimum size. */
+  assert(buffer_size >= sizeof(ph));
+
+  BUFFER_READ(&ph.type, sizeof(ph.type));
+  BUFFER_READ(&ph.length, sizeof(ph.length));
+  ph_length = ntohs(ph.length);
+
+  if ((ph_length <= sizeof(ph)) || (ph_length > buffer_size)) {
+    ERROR("network plugin: Compressed part with invalid length received.");
+    return -1;
+  }
+
+  /* A compressed part may only contain ordinary parts. Nesting them would
+   * allow for tiny packets expanding into huge amounts of data. */
+  if (flags & PP_COMPRESSED) {
+    ERROR("network plugin: Compressed part within a compressed part "
+          "received.");
+    return -1;
+  }
+
+#if HAVE_ZLIB
+  struct sockent_server *ses = &se->data.server;
+  int status;
+
+  if (ses->zstream == NULL) {
+    ses->inflate_buffer = malloc(COMPR_INFLATE_MAX);
+    ses->zstream = calloc(1, sizeof(*ses->zstream));
+    if ((ses->inflate_buffer == NULL) || (ses->zstream == NULL)) {
+      ERROR("network plugin: malloc failed.");
+      sfree(ses->inflate_buffer);
+      sfree(ses->zstream);
+      return -1;
+    }
+
+    status = inflateInit(ses->zstream);
+    if (status != Z_OK) {
+      ERROR("network plugin: inflateInit failed with status %i.", status);
+      sfree(ses->inflate_buffer);
+      sfree(ses->zstream);
+      return -1;
+    }
+  } else {
+    inflateReset(ses->zstream);
+  }
+
+  ses->zstream->next_in = (Bytef *)(buffer + buffer_offset);
+  ses->zstream->avail_in = (uInt)(ph_length - buffer_offset);
+  ses->zstream->next_out = (Bytef *)ses->inflate_buffer;
+  ses->zstream->avail_out = COMPR_INFLATE_MAX;
+
+  status = inflate(ses->zstream, Z_FINISH);
+  if (status != Z_STREAM_END) {
+    if ((status == Z_BUF_ERROR) && (ses->zstream->avail_out == 0))
+      ERROR("network plugin: Compressed part expands to more than %d bytes.",
+            COMPR_INFLATE_MAX);
+    else
+      ERROR("network plugin: Decompressing part failed: %s",
+            (ses->zstream->msg != NULL) ? ses->zstream->msg : "truncated");
+    return -1;
+  }
+
+  parse_packet(se, ses->inflate_buffer, (size_t)ses->zstream->total_out,
+               flags | PP_COMPRESSED, username, sender);
+#else
+  static int warning_has_been_printed;
+
+  if (warning_has_been_printed == 0) {
+    WARNING("network plugin: Received compressed packet, but the network "
+            "plugin was not linked with zlib, so I cannot decompress it. "
+            "The part will be discarded.");
+    warning_has_been_printed = 1;
+  }
+#endif
+
+  *ret_buffer = buffer + ph_length;
+  *ret_buffer_size = buffer_size - ph_length;
+
+  return 0;
+} /* }}} int parse_part_compr_zlib */
+
 #undef BUFFER_READ
 
 static int parse_packet(sockent_t *se, /* {{{ */
@@ -1345,6 +1798,11 @@ static int parse_packet(sockent_t *se, /* {{{ */
   value_list_t vl = VALUE_LIST_INIT;
   notification_t n = {0};
 
+  /* Shared by all value lists of the packet. */
+  value_t *values = NULL;
+  size_t values_size = 0;
+  meta_data_t *meta = NULL;
+
 #if HAVE_GCRYPT_H
   int packet_was_signed = (flags & PP_SIGNED);
   int packet_was_encrypted = (flags & PP_ENCRYPTED);
@@ -1420,29 +1878,34 @@ static int parse_packet(sockent_t *se, /* {{{ */
       continue;
     }
 #endif /* HAVE_GCRYPT_H */
-    else if (pkg_type == TYPE_VALUES) {
-      status =
-          parse_part_values(&buffer, &buffer_size, &vl.values, &vl.values_len);
+    else if (flags & PP_RELAY) {
+      /* The rest of the packet has passed the security checks above. Send it
+       * on as is; the servers sign or encrypt it again if configured to. */
+      network_send_buffer(buffer, buffer_size, SEND_TO_ALL);
+      if (!(flags & PP_SAMPLE)) {
+        buffer_size = 0;
+        break;
+      }
+      flags &= ~(PP_RELAY | PP_SAMPLE);
+    } else if (pkg_type == TYPE_VALUES) {
+      status = parse_part_values(&buffer, &buffer_size, &values, &values_size,
+                                 &vl.values_len);
       if (status != 0)
         break;
 
-      network_dispatch_values(&vl, username, address);
-
-      sfree(vl.values);
+      vl.values = values;
+      network_dispatch_values(&vl, &meta, username, address);
+      se->data.server.values_num++;
     } else if (pkg_type == TYPE_TIME) {
       uint64_t tmp = 0;
       status = parse_part_number(&buffer, &buffer_size, &tmp);
-      if (status == 0) {
+      if (status == 0)
         vl.time = TIME_T_TO_CDTIME_T(tmp);
-        n.time = TIME_T_TO_CDTIME_T(tmp);
-      }
     } else if (pkg_type == TYPE_TIME_HR) {
       uint64_t tmp = 0;
       status = parse_part_number(&buffer, &buffer_size, &tmp);
-      if (status == 0) {
+      if (status == 0)
         vl.time = (cdtime_t)tmp;
-        n.time = (cdtime_t)tmp;
-      }
     } else if (pkg_type == TYPE_INTERVAL) {
       uint64_t tmp = 0;
       status = parse_part_number(&buffer, &buffer_size, &tmp);
@@ -1456,33 +1919,24 @@ static int parse_packet(sockent_t *se, /* {{{ */
     } else if (pkg_type == TYPE_HOST) {
       status =
           parse_part_string(&buffer, &buffer_size, vl.host, sizeof(vl.host));
-      if (status == 0)
-        sstrncpy(n.host, vl.host, sizeof(n.host));
     } else if (pkg_type == TYPE_PLUGIN) {
       status = parse_part_string(&buffer, &buffer_size, vl.plugin,
                                  sizeof(vl.plugin));
-      if (status == 0)
-        sstrncpy(n.plugin, vl.plugin, sizeof(n.plugin));
     } else if (pkg_type == TYPE_PLUGIN_INSTANCE) {
       status = parse_part_string(&buffer, &buffer_size, vl.plugin_instance,
                                  sizeof(vl.plugin_instance));
-      if (status == 0)
-        sstrncpy(n.plugin_instance, vl.plugin_instance,
-                 sizeof(n.plugin_instance));
     } else if (pkg_type == TYPE_TYPE) {
       status =
           parse_part_string(&buffer, &buffer_size, vl.type, sizeof(vl.type));
-      if (status == 0)
-        sstrncpy(n.type, vl.type, sizeof(n.type));
     } else if (pkg_type == TYPE_TYPE_INSTANCE) {
       status = parse_part_string(&buffer, &buffer_size, vl.type_instance,
                                  sizeof(vl.type_instance));
-      if (status == 0)
-        sstrncpy(n.type_instance, vl.type_instance, sizeof(n.type_instance));
     } else if (pkg_type == TYPE_MESSAGE) {
       status = parse_part_string(&buffer, &buffer_size, n.message,
                                  sizeof(n.message));
 
+      /* Notifications share the identifier and time parts with the value
+       * lists, so they're only copied when a notification is complete. */
       if (status != 0) {
         /* do nothing */
       } else if ((n.severity != NOTIF_FAILURE) &&
@@ -1491,7 +1945,7 @@ static int parse_packet(sockent_t *se, /* {{{ */
              "Ignoring notification with "
              "unknown severity %i.",
              n.severity);
-      } else if (n.time == 0) {
+      } else if (vl.time == 0) {
         INFO("network plugin: "
              "Ignoring notification with "
              "time == 0.");
@@ -1500,6 +1954,13 @@ static int parse_packet(sockent_t *se, /* {{{ */
              "Ignoring notification with "
              "an empty message.");
       } else {
+        n.time = vl.time;
+        sstrncpy(n.host, vl.host, sizeof(n.host));
+        sstrncpy(n.plugin, vl.plugin, sizeof(n.plugin));
+        sstrncpy(n.plugin_instance, vl.plugin_instance,
+                 sizeof(n.plugin_instance));
+        sstrncpy(n.type, vl.type, sizeof(n.type));
+        sstrncpy(n.type_instance, vl.type_instance, sizeof(n.type_instance));
         network_dispatch_notification(&n);
       }
     } else if (pkg_type == TYPE_SEVERITY) {
@@ -1507,6 +1968,11 @@ static int parse_packet(sockent_t *se, /* {{{ */
       status = parse_part_number(&buffer, &buffer_size, &tmp);
       if (status == 0)
         n.severity = (int)tmp;
+    } else if (pkg_type == TYPE_COMPR_ZLIB) {
+      status = parse_part_compr_zlib(se, &buffer, &buffer_size, flags,
+                                     username, address);
+      if (status != 0)
+        break;
     } else {
       DEBUG("network plugin: parse_packet: Unknown part"
             " type: 0x%04hx",
@@ -1520,6 +1986,9 @@ static int parse_packet(sockent_t *se, /* {{{ */
     WARNING("network plugin: parse_packet: Received truncated "
             "packet, try increasing `MaxPacketSize'");
 
+  meta_data_destroy(meta);
+  sfree(values);
+
   return status;
 } /* }}} int parse_packet */
 
@@ -1537,6 +2006,13 @@ static void free_sockent_client(struct sockent_client *sec) /* {{{ */
   if (sec->cypher != NULL)
     gcry_cipher_close(sec->cypher);
 #endif
+  if (sec->stream != NULL) {
+    assert(!sec->stream->thread_running);
+    pthread_cond_destroy(&sec->stream->cond);
+    sfree(sec->stream->buffer);
+    sfree(sec->stream->out);
+    sfree(sec->stream);
+  }
 } /* }}} void free_sockent_client */
 
 static void free_sockent_server(struct sockent_server *ses) /* {{{ */
@@ -1552,8 +2028,14 @@ static void free_sockent_server(struct sockent_server *ses) /* {{{ */
 #if HAVE_GCRYPT_H
   sfree(ses->auth_file);
   fbh_destroy(ses->userdb);
-  if (ses->cypher != NULL)
-    gcry_cipher_close(ses->cypher);
+  server_users_destroy(ses->users);
+#endif
+#if HAVE_ZLIB
+  if (ses->zstream != NULL) {
+    inflateEnd(ses->zstream);
+    sfree(ses->zstream);
+  }
+  sfree(ses->inflate_buffer);
 #endif
 } /* }}} void free_sockent_server */
 
@@ -1751,7 +2233,7 @@ static int network_bind_socket_to_addr(sockent_t *se,
 } /* int network_bind_socket_to_addr */
 
 static int network_bind_socket(int fd, const struct addrinfo *ai,
-                               const int interface_idx) {
+                               const int interface_idx, bool reuseport) {
 #if KERNEL_SOLARIS
   char loop = 0;
 #else
@@ -1764,6 +2246,18 @@ static int network_bind_socket(int fd, const struct addrinfo *ai,
     return -1;
   }
 
+#ifdef SO_REUSEPORT
+  /* let the kernel balance the packets over the receivers' sockets */
+  if (reuseport &&
+      (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &(int){1}, sizeof(int)) ==
+       -1)) {
+    ERROR("network plugin: setsockopt (reuseport): %s", STRERRNO);
+    return -1;
+  }
+#else
+  assert(!reuseport);
+#endif
+
   DEBUG("fd = %i; calling `bind'", fd);
 
   if (bind(fd, ai->ai_addr, ai->ai_addrlen) == -1) {
@@ -1883,6 +2377,7 @@ static sockent_t *sockent_create(int type) /* {{{ */
     return NULL;
 
   se->type = type;
+  se->socktype = SOCK_DGRAM;
   se->node = NULL;
   se->service = NULL;
   se->interface = 0;
@@ -1892,11 +2387,16 @@ static sockent_t *sockent_create(int type) /* {{{ */
   if (type == SOCKENT_TYPE_SERVER) {
     se->data.server.fd = NULL;
     se->data.server.fd_num = 0;
+    se->data.server.receiver = 0;
 #if HAVE_GCRYPT_H
     se->data.server.security_level = SECURITY_LEVEL_NONE;
     se->data.server.auth_file = NULL;
     se->data.server.userdb = NULL;
-    se->data.server.cypher = NULL;
+    se->data.server.users = NULL;
+#endif
+#if HAVE_ZLIB
+    se->data.server.zstream = NULL;
+    se->data.server.inflate_buffer = NULL;
 #endif
   } else {
     se->data.client.fd = -1;
@@ -1904,6 +2404,8 @@ static sockent_t *sockent_create(int type) /* {{{ */
     se->data.client.bind_addr = NULL;
     se->data.client.resolve_interval = 0;
     se->data.client.next_resolve_reconnect = 0;
+    se->data.client.compress = false;
+    se->data.client.stream = NULL;
 #if HAVE_GCRYPT_H
     se->data.client.security_level = SECURITY_LEVEL_NONE;
     se->data.client.username = NULL;
@@ -1915,6 +2417,43 @@ static sockent_t *sockent_create(int type) /* {{{ */
   return se;
 } /* }}} sockent_t *sockent_create */
 
+/* Creates an unopened server socket with the same configuration as `orig'. */
+static sockent_t *sockent_server_clone(const sockent_t *orig) /* {{{ */
+{
+  sockent_t *se;
+
+  assert(orig->type == SOCKENT_TYPE_SERVER);
+
+  se = sockent_create(SOCKENT_TYPE_SERVER);
+  if (se == NULL)
+    return NULL;
+
+  if (orig->node != NULL)
+    se->node = strdup(orig->node);
+  if (orig->service != NULL)
+    se->service = strdup(orig->service);
+  se->interface = orig->interface;
+  se->socktype = orig->socktype;
+#if HAVE_GCRYPT_H
+  se->data.server.security_level = orig->data.server.security_level;
+  if (orig->data.server.auth_file != NULL)
+    se->data.server.auth_file = strdup(orig->data.server.auth_file);
+#endif
+
+  if (((orig->node != NULL) && (se->node == NULL)) ||
+      ((orig->service != NULL) && (se->service == NULL))
+#if HAVE_GCRYPT_H
+      || ((orig->data.server.auth_file != NULL) &&
+          (se->data.server.auth_file == NULL))
+#endif
+  ) {
+    sockent_destroy(se);
+    return NULL;
+  }
+
+  return se;
+} /* }}} sockent_t *sockent_server_clone */
+
 static int sockent_init_crypto(sockent_t *se) /* {{{ */
 {
 #if HAVE_GCRYPT_H /* {{{ */
@@ -2101,10 +2640,11 @@ static int sockent_server_listen(sockent_t *se) /* {{{ */
   DEBUG("network plugin: sockent_server_listen: node = %s; service = %s;", node,
         service);
 
-  struct addrinfo ai_hints = {.ai_family = AF_UNSPEC,
-                              .ai_flags = AI_ADDRCONFIG | AI_PASSIVE,
-                              .ai_protocol = IPPROTO_UDP,
-                              .ai_socktype = SOCK_DGRAM};
+  struct addrinfo ai_hints = {
+      .ai_family = AF_UNSPEC,
+      .ai_flags = AI_ADDRCONFIG | AI_PASSIVE,
+      .ai_protocol = (se->socktype == SOCK_STREAM) ? IPPROTO_TCP : IPPROTO_UDP,
+      .ai_socktype = se->socktype};
 
   status = getaddrinfo(node, service, &ai_hints, &ai_list);
   if (status != 0) {
@@ -2133,13 +2673,25 @@ static int sockent_server_listen(sockent_t *se) /* {{{ */
       continue;
     }
 
-    status = network_bind_socket(*tmp, ai_ptr, se->interface);
+    status = network_bind_socket(*tmp, ai_ptr, se->interface,
+                                 /* reuseport = */ receivers_num > 1);
     if (status != 0) {
       close(*tmp);
       *tmp = -1;
       continue;
     }
 
+    if (se->socktype == SOCK_STREAM) {
+      int flags = fcntl(*tmp, F_GETFL);
+      if ((listen(*tmp, SOMAXCONN) != 0) || (flags < 0) ||
+          (fcntl(*tmp, F_SETFL, flags | O_NONBLOCK) != 0)) {
+        ERROR("network plugin: listen(2) failed: %s", STRERRNO);
+        close(*tmp);
+        *tmp = -1;
+        continue;
+      }
+    }
+
     se->data.server.fd_num++;
     continue;
   } /* for (ai_list) */
@@ -2160,25 +2712,34 @@ static int sockent_add(sockent_t *se) /* {{{ */
     return -1;
 
   if (se->type == SOCKENT_TYPE_SERVER) {
+    receiver_t *r;
     struct pollfd *tmp;
 
-    tmp = realloc(listen_sockets_pollfd,
-                  sizeof(*tmp) * (listen_sockets_num + se->data.server.fd_num));
-    if (tmp == NULL) {
-      ERROR("network plugin: realloc failed.");
-      return -1;
-    }
-    listen_sockets_pollfd = tmp;
-    tmp = listen_sockets_pollfd + listen_sockets_num;
+    assert(se->data.server.receiver < receivers_num);
+    r = receivers + se->data.server.receiver;
 
-    for (size_t i = 0; i < se->data.server.fd_num; i++) {
-      memset(tmp + i, 0, sizeof(*tmp));
-      tmp[i].fd = se->data.server.fd[i];
-      tmp[i].events = POLLIN | POLLPRI;
-      tmp[i].revents = 0;
-    }
+    /* Stream listen sockets are polled by network_receive_stream(). */
+    if (se->socktype == SOCK_STREAM) {
+      r->stream_listen_num += se->data.server.fd_num;
+    } else {
+      tmp = realloc(r->pollfd,
+                    sizeof(*tmp) * (r->pollfd_num + se->data.server.fd_num));
+      if (tmp == NULL) {
+        ERROR("network plugin: realloc failed.");
+        return -1;
+      }
+      r->pollfd = tmp;
+      tmp = r->pollfd + r->pollfd_num;
+
+      for (size_t i = 0; i < se->data.server.fd_num; i++) {
+        memset(tmp + i, 0, sizeof(*tmp));
+        tmp[i].fd = se->data.server.fd[i];
+        tmp[i].events = POLLIN | POLLPRI;
+        tmp[i].revents = 0;
+      }
 
-    listen_sockets_num += se->data.server.fd_num;
+      r->pollfd_num += se->data.server.fd_num;
+    }
 
     if (listen_sockets == NULL) {
       listen_sockets = se;
@@ -2201,81 +2762,436 @@ static int sockent_add(sockent_t *se) /* {{{ */
   return 0;
 } /* }}} int sockent_add */
 
-static void *dispatch_thread(void __attribute__((unused)) * arg) /* {{{ */
+static void receive_entry_free(receive_list_entry_t *ent) /* {{{ */
+{
+  if (ent == NULL)
+    return;
+
+  sfree(ent->data);
+  sfree(ent);
+} /* }}} void receive_entry_free */
+
+/* Fills `ents' with `num' entries, reusing entries from the free list if
+ * possible. Returns the number of entries, which is only less than `num' if
+ * allocating failed. */
+static size_t receive_entries_get(receive_list_entry_t **ents, /* {{{ */
+                                  size_t num) {
+  size_t have = 0;
+
+  pthread_mutex_lock(&receive_free_list_lock);
+  while ((have < num) && (receive_free_list != NULL)) {
+    ents[have] = receive_free_list;
+    receive_free_list = receive_free_list->next;
+    receive_free_list_num--;
+    have++;
+  }
+  pthread_mutex_unlock(&receive_free_list_lock);
+
+  for (; have < num; have++) {
+    receive_list_entry_t *ent = calloc(1, sizeof(*ent));
+    if (ent == NULL)
+      break;
+
+    ent->data = malloc(network_config_packet_size);
+    if (ent->data == NULL) {
+      sfree(ent);
+      break;
+    }
+    ents[have] = ent;
+  }
+
+  for (size_t i = 0; i < have; i++)
+    ents[i]->next = NULL;
+
+  return have;
+} /* }}} size_t receive_entries_get */
+
+/* Returns a list of entries to the free list, freeing those that don't fit. */
+static void receive_entries_put(receive_list_entry_t *head) /* {{{ */
+{
+  pthread_mutex_lock(&receive_free_list_lock);
+  while ((head != NULL) && (receive_free_list_num < RECEIVE_FREE_LIST_MAX)) {
+    receive_list_entry_t *next = head->next;
+
+    head->next = receive_free_list;
+    receive_free_list = head;
+    receive_free_list_num++;
+
+    head = next;
+  }
+  pthread_mutex_unlock(&receive_free_list_lock);
+
+  while (head != NULL) {
+    receive_list_entry_t *next = head->next;
+    receive_entry_free(head);
+    head = next;
+  }
+} /* }}} void receive_entries_put */
+
+static void receive_free_list_destroy(void) /* {{{ */
+{
+  pthread_mutex_lock(&receive_free_list_lock);
+  receive_list_entry_t *head = receive_free_list;
+  receive_free_list = NULL;
+  receive_free_list_num = 0;
+  pthread_mutex_unlock(&receive_free_list_lock);
+
+  while (head != NULL) {
+    receive_list_entry_t *next = head->next;
+    receive_entry_free(head);
+    head = next;
+  }
+} /* }}} void receive_free_list_destroy */
+
+/* Creates the receivers when the first listen socket is configured. Their
+ * number can't change afterwards. */
+static int receivers_create(void) /* {{{ */
+{
+  if (receivers != NULL)
+    return 0;
+
+  receivers = calloc(network_config_receive_threads, sizeof(*receivers));
+  if (receivers == NULL) {
+    ERROR("network plugin: calloc failed.");
+    return -1;
+  }
+  receivers_num = network_config_receive_threads;
+
+  for (size_t i = 0; i < receivers_num; i++) {
+    pthread_mutex_init(&receivers[i].list_lock, /* attr = */ NULL);
+    pthread_cond_init(&receivers[i].list_cond, /* attr = */ NULL);
+  }
+
+  return 0;
+} /* }}} int receivers_create */
+
+static void receivers_destroy(void) /* {{{ */
+{
+  for (size_t i = 0; i < receivers_num; i++) {
+    receiver_t *r = receivers + i;
+
+    assert(!r->receive_thread_running && !r->dispatch_thread_running);
+
+    receive_entries_put(r->list_head);
+    sfree(r->pollfd);
+    pthread_cond_destroy(&r->list_cond);
+    pthread_mutex_destroy(&r->list_lock);
+  }
+
+  sfree(receivers);
+  receivers_num = 0;
+} /* }}} void receivers_destroy */
+
+/* Returns the statistics of the sender `sa', creating them if necessary. The
+ * caller must hold `sender_stats_lock'. Returns NULL if too many senders are
+ * tracked already. */
+static sender_stats_t * /* {{{ */
+sender_stats_get(const struct sockaddr_storage *sa) {
+  static c_complain_t complaint = C_COMPLAIN_INIT_STATIC;
+
+  sender_stats_t key = {.family = sa->ss_family};
+  if (sa->ss_family == AF_INET) {
+    const struct sockaddr_in *sin = (const struct sockaddr_in *)sa;
+    memcpy(key.addr, &sin->sin_addr, sizeof(sin->sin_addr));
+  } else if (sa->ss_family == AF_INET6) {
+    const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *)sa;
+    memcpy(key.addr, &sin6->sin6_addr, sizeof(sin6->sin6_addr));
+  }
+
+  uint32_t hash = key.family;
+  for (size_t i = 0; i < sizeof(key.addr); i++)
+    hash = (hash * 31) + key.addr[i];
+  sender_stats_t **bucket = sender_stats + (hash % SENDER_STATS_BUCKETS);
+
+  for (sender_stats_t *ss = *bucket; ss != NULL; ss = ss->next)
+    if ((ss->family == key.family) &&
+        (memcmp(ss->addr, key.addr, sizeof(key.addr)) == 0))
+      return ss;
+
+  if (sender_stats_num >= SENDER_STATS_MAX) {
+    c_complain(LOG_NOTICE, &complaint,
+               "network plugin: Packets were received from more than %d "
+               "addresses. Not collecting statistics for new senders.",
+               SENDER_STATS_MAX);
+    return NULL;
+  }
+
+  sender_stats_t *ss = malloc(sizeof(*ss));
+  if (ss == NULL)
+    return NULL;
+  *ss = key;
+  ss->next = *bucket;
+  *bucket = ss;
+  sender_stats_num++;
+
+  return ss;
+} /* }}} sender_stats_t *sender_stats_get */
+
+static void sender_stats_destroy(void) /* {{{ */
+{
+  pthread_mutex_lock(&sender_stats_lock);
+  for (size_t i = 0; i < SENDER_STATS_BUCKETS; i++) {
+    while (sender_stats[i] != NULL) {
+      sender_stats_t *next = sender_stats[i]->next;
+      sfree(sender_stats[i]);
+      sender_stats[i] = next;
+    }
+  }
+  sender_stats_num = 0;
+  pthread_mutex_unlock(&sender_stats_lock);
+} /* }}} void sender_stats_destroy */
+
+/* Frees dropped packets, counting them for their senders. */
+static void receive_entries_drop(receive_list_entry_t *head) /* {{{ */
+{
+  uint64_t num = 0;
+
+  if (network_config_stats)
+    pthread_mutex_lock(&sender_stats_lock);
+  for (receive_list_entry_t *ent = head; ent != NULL; ent = ent->next) {
+    if (network_config_stats) {
+      sender_stats_t *ss = sender_stats_get(&ent->sender);
+      if (ss != NULL)
+        ss->dropped++;
+    }
+    num++;
+  }
+  if (network_config_stats)
+    pthread_mutex_unlock(&sender_stats_lock);
+
+  __atomic_fetch_add(&stats_packets_dropped, (derive_t)num, __ATOMIC_RELAXED);
+  receive_entries_put(head);
+} /* }}} void receive_entries_drop */
+
+/* Detaches the first `num' entries of the list starting at `*head' and
+ * returns them. `*head' is set to the remaining entries. */
+static receive_list_entry_t * /* {{{ */
+receive_list_split(receive_list_entry_t **head, uint64_t num) {
+  receive_list_entry_t *first = *head;
+  receive_list_entry_t *last = NULL;
+
+  for (uint64_t i = 0; (i < num) && (*head != NULL); i++) {
+    last = *head;
+    *head = (*head)->next;
+  }
+  if (last == NULL)
+    return NULL;
+
+  last->next = NULL;
+  return first;
+} /* }}} receive_list_entry_t *receive_list_split */
+
+/* Appends a list of received packets to the receiver's queue and wakes up its
+ * dispatch thread. If the queue would exceed `receive_queue_max', the newest
+ * or oldest packets are dropped. The caller must hold `r->list_lock'. */
+static void receiver_enqueue(receiver_t *r, /* {{{ */
+                             receive_list_entry_t *head,
+                             receive_list_entry_t *tail, uint64_t length) {
+  assert(((r->list_head == NULL) && (r->list_length == 0)) ||
+         ((r->list_head != NULL) && (r->list_length != 0)));
+
+  receive_list_entry_t *dropped = NULL;
+  if ((receive_queue_max > 0) &&
+      (r->list_length + length > receive_queue_max)) {
+    uint64_t excess = r->list_length + length - receive_queue_max;
+
+    if (network_config_receive_queue_policy == RECEIVE_QUEUE_DROP_NEWEST) {
+      /* Keep the head of the new packets, drop their tail. */
+      uint64_t keep = (excess < length) ? length - excess : 0;
+      dropped = head;
+      head = receive_list_split(&dropped, keep);
+      length = keep;
+      if (head == NULL) {
+        receive_entries_drop(dropped);
+        return;
+      }
+      for (tail = head; tail->next != NULL; tail = tail->next)
+        /* find the new tail */;
+    } else {
+      /* Drop the oldest packets, which may include some of the new ones. */
+      uint64_t old_num = (excess < r->list_length) ? excess : r->list_length;
+      receive_entries_drop(receive_list_split(&r->list_head, old_num));
+      r->list_length -= old_num;
+      if (r->list_head == NULL)
+        r->list_tail = NULL;
+
+      dropped = receive_list_split(&head, excess - old_num);
+      length -= excess - old_num;
+    }
+  }
+
+  if (r->list_head == NULL)
+    r->list_head = head;
+  else
+    r->list_tail->next = head;
+  r->list_tail = tail;
+  r->list_length += length;
+
+  if (dropped != NULL)
+    receive_entries_drop(dropped);
+
+  pthread_cond_signal(&r->list_cond);
+} /* }}} void receiver_enqueue */
+
+static sockent_t *listen_socket_by_fd(int fd) /* {{{ */
+{
+  for (sockent_t *se = listen_sockets; se != NULL; se = se->next) {
+    for (size_t i = 0; i < se->data.server.fd_num; i++)
+      if (se->data.server.fd[i] == fd)
+        return se;
+  }
+
+  return NULL;
+} /* }}} sockent_t *listen_socket_by_fd */
+
+static void *dispatch_thread(void *arg) /* {{{ */
 {
+  receiver_t *r = arg;
+  uint64_t packets_num = 0;
+
   while (42) {
-    receive_list_entry_t *ent;
-    sockent_t *se;
+    receive_list_entry_t *head;
 
-    /* Lock and wait for more data to come in */
-    pthread_mutex_lock(&receive_list_lock);
-    while ((listen_loop == 0) && (receive_list_head == NULL))
-      pthread_cond_wait(&receive_list_cond, &receive_list_lock);
+    /* Lock and wait for more data to come in, then take all of it. */
+    pthread_mutex_lock(&r->list_lock);
+    while ((listen_loop == 0) && (r->list_head == NULL))
+      pthread_cond_wait(&r->list_cond, &r->list_lock);
 
-    /* Remove the head entry and unlock */
-    ent = receive_list_head;
-    if (ent != NULL)
-      receive_list_head = ent->next;
-    receive_list_length--;
-    pthread_mutex_unlock(&receive_list_lock);
+    head = r->list_head;
+    r->list_head = NULL;
+    r->list_tail = NULL;
+    r->list_length = 0;
+    pthread_mutex_unlock(&r->list_lock);
 
     /* Check whether we are supposed to exit. We do NOT check `listen_loop'
      * because we dispatch all missing packets before shutting down. */
-    if (ent == NULL)
+    if (head == NULL)
       break;
 
-    /* Look for the correct `sockent_t' */
-    se = listen_sockets;
-    while (se != NULL) {
-      size_t i;
-
-      for (i = 0; i < se->data.server.fd_num; i++)
-        if (se->data.server.fd[i] == ent->fd)
-          break;
+    sockent_t *se = NULL;
+    int se_fd = -1;
+    for (receive_list_entry_t *ent = head; ent != NULL; ent = ent->next) {
+      /* Consecutive packets usually arrive on the same socket. */
+      if ((se == NULL) || (ent->fd != se_fd)) {
+        se = listen_socket_by_fd(ent->fd);
+        se_fd = ent->fd;
+      }
 
-      if (i < se->data.server.fd_num)
-        break;
+      if (se == NULL) {
+        ERROR("network plugin: Got packet from FD %i, but can't "
+              "find an appropriate socket entry.",
+              ent->fd);
+        continue;
+      }
 
-      se = se->next;
-    }
+      int flags = 0;
+      if (network_config_relay) {
+        flags |= PP_RELAY;
+        packets_num++;
+        if ((network_config_relay_sample > 0) &&
+            ((packets_num % (uint64_t)network_config_relay_sample) == 0))
+          flags |= PP_SAMPLE;
+      }
 
-    if (se == NULL) {
-      ERROR("network plugin: Got packet from FD %i, but can't "
-            "find an appropriate socket entry.",
-            ent->fd);
-      sfree(ent->data);
-      sfree(ent);
-      continue;
+      uint64_t values_num = se->data.server.values_num;
+      CD_PROBE2(network_parse_start, ent, ent->data_len);
+      parse_packet(se, ent->data, ent->data_len, flags,
+                   /* username = */ NULL, &ent->sender);
+      CD_PROBE2(network_parse_end, ent,
+                se->data.server.values_num - values_num);
+
+      if (network_config_stats) {
+        pthread_mutex_lock(&sender_stats_lock);
+        sender_stats_t *ss = sender_stats_get(&ent->sender);
+        if (ss != NULL) {
+          ss->packets++;
+          ss->values += se->data.server.values_num - values_num;
+        }
+        pthread_mutex_unlock(&sender_stats_lock);
+      }
     }
 
-    parse_packet(se, ent->data, ent->data_len, /* flags = */ 0,
-                 /* username = */ NULL, &ent->sender);
-    sfree(ent->data);
-    sfree(ent);
+    receive_entries_put(head);
   } /* while (42) */
 
   return NULL;
 } /* }}} void *dispatch_thread */
 
-static int network_receive(void) /* {{{ */
-{
-  char buffer[network_config_packet_size];
-  int buffer_len;
+/* Receives up to `num' packets from `fd' into `ents'. Returns the number of
+ * packets received or -1 on error. */
+static int network_receive_batch(int fd, receive_list_entry_t **ents, /* {{{ */
+                                 size_t num) {
+#if HAVE_RECVMMSG
+  struct mmsghdr msgs[RECEIVE_BATCH_SIZE];
+  struct iovec iovs[RECEIVE_BATCH_SIZE];
+
+  if (num > RECEIVE_BATCH_SIZE)
+    num = RECEIVE_BATCH_SIZE;
+
+  for (size_t i = 0; i < num; i++) {
+    memset(&ents[i]->sender, 0, sizeof(ents[i]->sender));
+    iovs[i] = (struct iovec){
+        .iov_base = ents[i]->data,
+        .iov_len = network_config_packet_size,
+    };
+    msgs[i] = (struct mmsghdr){
+        .msg_hdr =
+            {
+                .msg_name = &ents[i]->sender,
+                .msg_namelen = sizeof(ents[i]->sender),
+                .msg_iov = iovs + i,
+                .msg_iovlen = 1,
+            },
+    };
+  }
+
+  /* poll(2) said the socket is readable, so this returns at least one packet
+   * unless another thread was faster. Don't wait for the batch to fill up. */
+  int status = recvmmsg(fd, msgs, (unsigned int)num, MSG_DONTWAIT,
+                        /* timeout = */ NULL);
+  if (status < 0)
+    return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+
+  for (int i = 0; i < status; i++)
+    ents[i]->data_len = (int)msgs[i].msg_len;
+  return status;
+#else
+  if (num < 1)
+    return 0;
 
+  socklen_t length = sizeof(ents[0]->sender);
+  memset(&ents[0]->sender, 0, length);
+  ssize_t status =
+      recvfrom(fd, ents[0]->data, network_config_packet_size, 0 /* no flags */,
+               (struct sockaddr *)&ents[0]->sender, &length);
+  if (status < 0)
+    return -1;
+
+  ents[0]->data_len = (int)status;
+  return 1;
+#endif
+} /* }}} int network_receive_batch */
+
+static int network_receive(receiver_t *r) /* {{{ */
+{
   int status = 0;
 
   receive_list_entry_t *private_list_head;
   receive_list_entry_t *private_list_tail;
   uint64_t private_list_length;
 
-  assert(listen_sockets_num > 0);
+  /* Entries ready to receive into. */
+  receive_list_entry_t *spare[RECEIVE_BATCH_SIZE];
+  size_t spare_num = 0;
+
+  assert(r->pollfd_num > 0);
 
   private_list_head = NULL;
   private_list_tail = NULL;
   private_list_length = 0;
 
   while (listen_loop == 0) {
-    status = poll(listen_sockets_pollfd, listen_sockets_num, -1);
+    status = poll(r->pollfd, r->pollfd_num, -1);
     if (status <= 0) {
       if (errno == EINTR)
         continue;
@@ -2283,75 +3199,54 @@ static int network_receive(void) /* {{{ */
       break;
     }
 
-    for (size_t i = 0; (i < listen_sockets_num) && (status > 0); i++) {
-      receive_list_entry_t *ent;
-
-      if ((listen_sockets_pollfd[i].revents & (POLLIN | POLLPRI)) == 0)
+    for (size_t i = 0; (i < r->pollfd_num) && (status > 0); i++) {
+      if ((r->pollfd[i].revents & (POLLIN | POLLPRI)) == 0)
         continue;
       status--;
 
-      struct sockaddr_storage address;
-      socklen_t length = sizeof(address);
-      memset(&address, 0, length);
-      buffer_len =
-          recvfrom(listen_sockets_pollfd[i].fd, buffer, sizeof(buffer),
-                   0 /* no flags */, (struct sockaddr *)&address, &length);
-      if (buffer_len < 0) {
-        status = (errno != 0) ? errno : -1;
-        ERROR("network plugin: recv(2) failed: %s", STRERRNO);
-        break;
-      }
-
-      stats_octets_rx += ((uint64_t)buffer_len);
-      stats_packets_rx++;
-
-      /* TODO: Possible performance enhancement: Do not free
-       * these entries in the dispatch thread but put them in
-       * another list, so we don't have to allocate more and
-       * more of these structures. */
-      ent = calloc(1, sizeof(*ent));
-      if (ent == NULL) {
-        ERROR("network plugin: calloc failed.");
+      spare_num += receive_entries_get(spare + spare_num,
+                                       RECEIVE_BATCH_SIZE - spare_num);
+      if (spare_num == 0) {
+        ERROR("network plugin: Allocating receive buffers failed.");
         status = ENOMEM;
         break;
       }
 
-      ent->data = malloc(network_config_packet_size);
-      if (ent->data == NULL) {
-        sfree(ent);
-        ERROR("network plugin: malloc failed.");
-        status = ENOMEM;
+      int received = network_receive_batch(r->pollfd[i].fd, spare, spare_num);
+      if (received < 0) {
+        status = (errno != 0) ? errno : -1;
+        ERROR("network plugin: recv(2) failed: %s", STRERRNO);
         break;
       }
-      ent->fd = listen_sockets_pollfd[i].fd;
-      ent->next = NULL;
 
-      memcpy(ent->data, buffer, buffer_len);
-      ent->data_len = buffer_len;
-      memcpy(&ent->sender, &address, sizeof(ent->sender));
+      for (int j = 0; j < received; j++) {
+        receive_list_entry_t *ent = spare[j];
 
-      if (private_list_head == NULL)
-        private_list_head = ent;
-      else
-        private_list_tail->next = ent;
-      private_list_tail = ent;
-      private_list_length++;
+        __atomic_fetch_add(&stats_octets_rx, (derive_t)ent->data_len,
+                           __ATOMIC_RELAXED);
+        __atomic_fetch_add(&stats_packets_rx, 1, __ATOMIC_RELAXED);
+        CD_PROBE2(network_receive, ent, ent->data_len);
 
-      /* Do not block here. Blocking here has led to
-       * insufficient performance in the past. */
-      if (pthread_mutex_trylock(&receive_list_lock) == 0) {
-        assert(((receive_list_head == NULL) && (receive_list_length == 0)) ||
-               ((receive_list_head != NULL) && (receive_list_length != 0)));
+        ent->fd = r->pollfd[i].fd;
+        ent->next = NULL;
 
-        if (receive_list_head == NULL)
-          receive_list_head = private_list_head;
+        if (private_list_head == NULL)
+          private_list_head = ent;
         else
-          receive_list_tail->next = private_list_head;
-        receive_list_tail = private_list_tail;
-        receive_list_length += private_list_length;
+          private_list_tail->next = ent;
+        private_list_tail = ent;
+        private_list_length++;
+      }
+      spare_num -= (size_t)received;
+      memmove(spare, spare + received, spare_num * sizeof(*spare));
 
-        pthread_cond_signal(&receive_list_cond);
-        pthread_mutex_unlock(&receive_list_lock);
+      /* Do not block here. Blocking here has led to
+       * insufficient performance in the past. */
+      if ((private_list_head != NULL) &&
+          (pthread_mutex_trylock(&r->list_lock) == 0)) {
+        receiver_enqueue(r, private_list_head, private_list_tail,
+                         private_list_length);
+        pthread_mutex_unlock(&r->list_lock);
 
         private_list_head = NULL;
         private_list_tail = NULL;
@@ -2359,116 +3254,735 @@ static int network_receive(void) /* {{{ */
       }
 
       status = 0;
-    } /* for (listen_sockets_pollfd) */
+    } /* for (r->pollfd) */
 
     if (status != 0)
       break;
   } /* while (listen_loop == 0) */
 
+  for (size_t i = 0; i < spare_num; i++)
+    receive_entry_free(spare[i]);
+
   /* Make sure everything is dispatched before exiting. */
   if (private_list_head != NULL) {
-    pthread_mutex_lock(&receive_list_lock);
-
-    if (receive_list_head == NULL)
-      receive_list_head = private_list_head;
-    else
-      receive_list_tail->next = private_list_head;
-    receive_list_tail = private_list_tail;
-    receive_list_length += private_list_length;
-
-    pthread_cond_signal(&receive_list_cond);
-    pthread_mutex_unlock(&receive_list_lock);
+    pthread_mutex_lock(&r->list_lock);
+    receiver_enqueue(r, private_list_head, private_list_tail,
+                     private_list_length);
+    pthread_mutex_unlock(&r->list_lock);
   }
 
   return status;
 } /* }}} int network_receive */
 
-static void *receive_thread(void __attribute__((unused)) * arg) {
-  return network_receive() ? (void *)1 : (void *)0;
+static void *receive_thread(void *arg) {
+  return network_receive(arg) ? (void *)1 : (void *)0;
 } /* void *receive_thread */
 
-static void network_init_buffer(void) {
-  memset(send_buffer, 0, network_config_packet_size);
-  send_buffer_ptr = send_buffer;
-  send_buffer_fill = 0;
-  send_buffer_last_update = 0;
+#if HAVE_SYS_EPOLL_H
+static stream_conn_t *stream_conn_create(receiver_t *r, int fd, /* {{{ */
+                                         int listen_fd) {
+  stream_conn_t *c = calloc(1, sizeof(*c));
+  if (c == NULL) {
+    ERROR("network plugin: calloc failed.");
+    return NULL;
+  }
 
-  memset(&send_buffer_vl, 0, sizeof(send_buffer_vl));
-} /* int network_init_buffer */
+  c->fd = fd;
+  c->listen_fd = listen_fd;
 
-static void network_send_buffer_plain(sockent_t *se, /* {{{ */
-                                      const char *buffer, size_t buffer_size) {
-  int status;
+  c->next = r->stream_conns;
+  if (c->next != NULL)
+    c->next->prev = c;
+  r->stream_conns = c;
 
-  while (42) {
-    status = sockent_client_connect(se);
-    if (status != 0)
-      return;
+  return c;
+} /* }}} stream_conn_t *stream_conn_create */
 
-    status = sendto(se->data.client.fd, buffer, buffer_size,
-                    /* flags = */ 0, (struct sockaddr *)se->data.client.addr,
-                    se->data.client.addrlen);
-    if (status < 0) {
-      if ((errno == EINTR) || (errno == EAGAIN))
-        continue;
+/* Closes a connection. The listen sockets are closed with their sockent. */
+static void stream_conn_destroy(receiver_t *r, stream_conn_t *c) /* {{{ */
+{
+  if (c->prev != NULL)
+    c->prev->next = c->next;
+  else
+    r->stream_conns = c->next;
+  if (c->next != NULL)
+    c->next->prev = c->prev;
+
+  if (c->fd != c->listen_fd)
+    close(c->fd);
+  sfree(c->buffer);
+  sfree(c);
+} /* }}} void stream_conn_destroy */
+
+static void stream_conn_accept(receiver_t *r, int efd, /* {{{ */
+                               stream_conn_t *listener) {
+  static c_complain_t complaint = C_COMPLAIN_INIT_STATIC;
 
-      ERROR("network plugin: sendto failed: %s. Closing sending socket.",
-            STRERRNO);
-      sockent_client_disconnect(se);
+  while (42) {
+    struct sockaddr_storage sender = {0};
+    socklen_t sender_len = sizeof(sender);
+
+    int fd = accept4(listener->fd, (struct sockaddr *)&sender, &sender_len,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+        c_complain(LOG_ERR, &complaint, "network plugin: accept(2) failed: %s",
+                   STRERRNO);
       return;
     }
+    c_release(LOG_INFO, &complaint,
+              "network plugin: Accepting connections again.");
 
-    break;
-  } /* while (42) */
-} /* }}} void network_send_buffer_plain */
+    stream_conn_t *c = stream_conn_create(r, fd, listener->fd);
+    if (c == NULL) {
+      close(fd);
+      continue;
+    }
+    memcpy(&c->sender, &sender, sizeof(c->sender));
 
-#if HAVE_GCRYPT_H
-#define BUFFER_ADD(p, s)                                                       \
-  do {                                                                         \
-    memcpy(buffer + buffer_offset, (p), (s));                                  \
-    buffer_offset += (s);                                                      \
-  } while (0)
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = c};
+    if (epoll_ctl(efd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+      ERROR("network plugin: epoll_ctl failed: %s", STRERRNO);
+      stream_conn_destroy(r, c);
+    }
+  }
+} /* }}} void stream_conn_accept */
 
-static void network_send_buffer_signed(sockent_t *se, /* {{{ */
-                                       const char *in_buffer,
-                                       size_t in_buffer_size) {
-  char buffer[BUFF_SIG_SIZE + in_buffer_size];
-  size_t buffer_offset;
-  size_t username_len;
+/* Appends a copy of a frame's packet to the private list. */
+static int stream_conn_queue(stream_conn_t *c, const char *data, /* {{{ */
+                             size_t data_len, receive_list_entry_t **head,
+                             receive_list_entry_t **tail, uint64_t *length) {
+  receive_list_entry_t *ent = NULL;
 
-  gcry_md_hd_t hd;
-  gcry_error_t err;
-  unsigned char *hash;
+  if (data_len == 0)
+    return 0;
 
-  hd = NULL;
-  err = gcry_md_open(&hd, GCRY_MD_SHA256, GCRY_MD_FLAG_HMAC);
-  if (err != 0) {
-    ERROR("network plugin: Creating HMAC object failed: %s",
-          gcry_strerror(err));
-    return;
+  if (receive_entries_get(&ent, 1) != 1) {
+    ERROR("network plugin: Allocating receive buffers failed.");
+    return ENOMEM;
   }
 
-  err = gcry_md_setkey(hd, se->data.client.password,
-                       strlen(se->data.client.password));
-  if (err != 0) {
-    ERROR("network plugin: gcry_md_setkey failed: %s", gcry_strerror(err));
-    gcry_md_close(hd);
-    return;
-  }
+  memcpy(ent->data, data, data_len);
+  ent->data_len = (int)data_len;
+  ent->fd = c->listen_fd;
+  memcpy(&ent->sender, &c->sender, sizeof(ent->sender));
 
-  username_len = strlen(se->data.client.username);
-  if (username_len > (BUFF_SIG_SIZE - PART_SIGNATURE_SHA256_SIZE)) {
-    ERROR("network plugin: Username too long: %s", se->data.client.username);
-    return;
-  }
+  __atomic_fetch_add(&stats_packets_rx, 1, __ATOMIC_RELAXED);
+  CD_PROBE2(network_receive, ent, ent->data_len);
 
-  memcpy(buffer + PART_SIGNATURE_SHA256_SIZE, se->data.client.username,
-         username_len);
-  memcpy(buffer + PART_SIGNATURE_SHA256_SIZE + username_len, in_buffer,
-         in_buffer_size);
+  if (*head == NULL)
+    *head = ent;
+  else
+    (*tail)->next = ent;
+  *tail = ent;
+  (*length)++;
 
-  /* Initialize the `ps' structure. */
-  part_signature_sha256_t ps = {
+  return 0;
+} /* }}} int stream_conn_queue */
+
+/* Returns the size of the packet in the frame starting at `header'. */
+static int stream_frame_size(const char *header, size_t *ret_size) /* {{{ */
+{
+  uint32_t tmp;
+
+  memcpy(&tmp, header, sizeof(tmp));
+  *ret_size = (size_t)ntohl(tmp);
+
+  if (*ret_size > network_config_packet_size) {
+    ERROR("network plugin: Received a frame of %" PRIsz " bytes, but "
+          "`MaxPacketSize' is %" PRIsz ". Closing the connection.",
+          *ret_size, network_config_packet_size);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int stream_frame_size */
+
+/* Reads from a connection and queues the complete frames. Returns non-zero if
+ * the connection is to be closed. */
+static int stream_conn_read(stream_conn_t *c, char *buffer, /* {{{ */
+                            receive_list_entry_t **head,
+                            receive_list_entry_t **tail, uint64_t *length) {
+  ssize_t status = read(c->fd, buffer, STREAM_READ_SIZE);
+  if (status < 0) {
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+      return 0;
+    NOTICE("network plugin: Reading from a connection failed: %s", STRERRNO);
+    return -1;
+  } else if (status == 0) {
+    return -1;
+  }
+
+  __atomic_fetch_add(&stats_octets_rx, (derive_t)status, __ATOMIC_RELAXED);
+
+  char *ptr = buffer;
+  size_t ptr_len = (size_t)status;
+  size_t packet_size;
+
+  while (ptr_len > 0) {
+    /* Fast path: complete frames are queued straight from the read buffer. */
+    if ((c->fill == 0) && (ptr_len >= STREAM_FRAME_HEADER_SIZE)) {
+      if (stream_frame_size(ptr, &packet_size) != 0)
+        return -1;
+
+      if (ptr_len >= STREAM_FRAME_HEADER_SIZE + packet_size) {
+        if (stream_conn_queue(c, ptr + STREAM_FRAME_HEADER_SIZE, packet_size,
+                              head, tail, length) != 0)
+          return -1;
+        ptr += STREAM_FRAME_HEADER_SIZE + packet_size;
+        ptr_len -= STREAM_FRAME_HEADER_SIZE + packet_size;
+        continue;
+      }
+    }
+
+    /* Collect the incomplete frame in the connection's buffer. */
+    if (c->buffer == NULL) {
+      c->buffer = malloc(STREAM_FRAME_HEADER_SIZE + network_config_packet_size);
+      if (c->buffer == NULL) {
+        ERROR("network plugin: malloc failed.");
+        return -1;
+      }
+    }
+
+    size_t want = STREAM_FRAME_HEADER_SIZE;
+    if (c->fill >= STREAM_FRAME_HEADER_SIZE) {
+      if (stream_frame_size(c->buffer, &packet_size) != 0)
+        return -1;
+      want += packet_size;
+    }
+
+    size_t copy = want - c->fill;
+    if (copy > ptr_len)
+      copy = ptr_len;
+    memcpy(c->buffer + c->fill, ptr, copy);
+    c->fill += copy;
+    ptr += copy;
+    ptr_len -= copy;
+
+    if (c->fill < STREAM_FRAME_HEADER_SIZE)
+      continue;
+    if (stream_frame_size(c->buffer, &packet_size) != 0)
+      return -1;
+    if (c->fill == STREAM_FRAME_HEADER_SIZE + packet_size) {
+      if (stream_conn_queue(c, c->buffer + STREAM_FRAME_HEADER_SIZE,
+                            packet_size, head, tail, length) != 0)
+        return -1;
+      c->fill = 0;
+    }
+  } /* while (ptr_len > 0) */
+
+  return 0;
+} /* }}} int stream_conn_read */
+
+/* Accepts connections on the receiver's stream listen sockets and reads
+ * frames from them, using epoll(7) so that many connections are cheap. */
+static int network_receive_stream(receiver_t *r) /* {{{ */
+{
+  size_t r_index = (size_t)(r - receivers);
+  struct epoll_event events[RECEIVE_BATCH_SIZE];
+  int status = 0;
+
+  /* Stop reading well before packets would be dropped. */
+  uint64_t queue_max = STREAM_QUEUE_MAX;
+  if ((receive_queue_max > 0) && (receive_queue_max / 2 < queue_max))
+    queue_max = receive_queue_max / 2;
+
+  int efd = epoll_create1(EPOLL_CLOEXEC);
+  if (efd < 0) {
+    ERROR("network plugin: epoll_create1 failed: %s", STRERRNO);
+    return -1;
+  }
+
+  char *buffer = malloc(STREAM_READ_SIZE);
+  if (buffer == NULL) {
+    ERROR("network plugin: malloc failed.");
+    close(efd);
+    return -1;
+  }
+
+  for (sockent_t *se = listen_sockets; se != NULL; se = se->next) {
+    if ((se->socktype != SOCK_STREAM) || (se->data.server.receiver != r_index))
+      continue;
+
+    for (size_t i = 0; i < se->data.server.fd_num; i++) {
+      int fd = se->data.server.fd[i];
+      stream_conn_t *c = stream_conn_create(r, fd, fd);
+      if (c == NULL)
+        continue;
+
+      struct epoll_event ev = {.events = EPOLLIN, .data.ptr = c};
+      if (epoll_ctl(efd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        ERROR("network plugin: epoll_ctl failed: %s", STRERRNO);
+        stream_conn_destroy(r, c);
+      }
+    }
+  }
+
+  while (listen_loop == 0) {
+    /* While the dispatch thread is behind, leave the data in the kernel. The
+     * TCP windows fill up and the senders slow down. */
+    if (__atomic_load_n(&r->list_length, __ATOMIC_RELAXED) >= queue_max) {
+      nanosleep(&(struct timespec){.tv_nsec = 1000000}, NULL);
+      continue;
+    }
+
+    int events_num = epoll_wait(efd, events, STATIC_ARRAY_SIZE(events), -1);
+    if (events_num < 0) {
+      if (errno == EINTR)
+        continue;
+      ERROR("network plugin: epoll_wait failed: %s", STRERRNO);
+      status = -1;
+      break;
+    }
+
+    receive_list_entry_t *head = NULL;
+    receive_list_entry_t *tail = NULL;
+    uint64_t length = 0;
+
+    for (int i = 0; i < events_num; i++) {
+      stream_conn_t *c = events[i].data.ptr;
+
+      if (c->fd == c->listen_fd) {
+        stream_conn_accept(r, efd, c);
+        continue;
+      }
+
+      if (stream_conn_read(c, buffer, &head, &tail, &length) != 0) {
+        epoll_ctl(efd, EPOLL_CTL_DEL, c->fd, NULL);
+        stream_conn_destroy(r, c);
+      }
+    }
+
+    if (head != NULL) {
+      pthread_mutex_lock(&r->list_lock);
+      receiver_enqueue(r, head, tail, length);
+      pthread_mutex_unlock(&r->list_lock);
+    }
+  } /* while (listen_loop == 0) */
+
+  while (r->stream_conns != NULL)
+    stream_conn_destroy(r, r->stream_conns);
+  sfree(buffer);
+  close(efd);
+
+  return status;
+} /* }}} int network_receive_stream */
+
+static void *stream_thread(void *arg) {
+  return network_receive_stream(arg) ? (void *)1 : (void *)0;
+} /* void *stream_thread */
+#endif /* HAVE_SYS_EPOLL_H */
+
+static void send_buffer_reset(send_buffer_t *sb) {
+  memset(sb->buffer, 0, network_config_packet_size);
+  sb->ptr = sb->buffer;
+  sb->fill = 0;
+  sb->last_update = 0;
+
+  memset(&sb->vl, 0, sizeof(sb->vl));
+} /* void send_buffer_reset */
+
+#if HAVE_ZLIB
+static void send_zbuffer_reset(send_zbuffer_t *zb) /* {{{ */
+{
+  deflateReset(&zb->stream);
+  zb->pending_fill = 0;
+
+  memset(&zb->vl, 0, sizeof(zb->vl));
+} /* }}} void send_zbuffer_reset */
+
+static send_zbuffer_t *send_zbuffer_create(void) /* {{{ */
+{
+  send_zbuffer_t *zb = calloc(1, sizeof(*zb));
+  if (zb == NULL) {
+    ERROR("network plugin: calloc failed.");
+    return NULL;
+  }
+
+  zb->packet = malloc(network_config_packet_size);
+  zb->pending = malloc(network_config_packet_size);
+  if ((zb->packet == NULL) || (zb->pending == NULL)) {
+    ERROR("network plugin: malloc failed.");
+    sfree(zb->packet);
+    sfree(zb->pending);
+    sfree(zb);
+    return NULL;
+  }
+
+  int status = deflateInit(&zb->stream, Z_DEFAULT_COMPRESSION);
+  if (status != Z_OK) {
+    ERROR("network plugin: deflateInit failed with status %i.", status);
+    sfree(zb->packet);
+    sfree(zb->pending);
+    sfree(zb);
+    return NULL;
+  }
+
+  return zb;
+} /* }}} send_zbuffer_t *send_zbuffer_create */
+
+static void send_zbuffer_destroy(send_zbuffer_t *zb) /* {{{ */
+{
+  if (zb == NULL)
+    return;
+
+  deflateEnd(&zb->stream);
+  sfree(zb->packet);
+  sfree(zb->pending);
+  sfree(zb);
+} /* }}} void send_zbuffer_destroy */
+#endif /* HAVE_ZLIB */
+
+/* Returns the calling thread's send buffer, creating it on first use. */
+static send_buffer_t *send_buffer_get(void) /* {{{ */
+{
+  send_buffer_t *sb = pthread_getspecific(send_buffer_key);
+  if (sb != NULL)
+    return sb;
+
+  sb = calloc(1, sizeof(*sb));
+  if (sb == NULL) {
+    ERROR("network plugin: calloc failed.");
+    return NULL;
+  }
+
+  sb->buffer = malloc(network_config_packet_size);
+  if (sb->buffer == NULL) {
+    ERROR("network plugin: malloc failed.");
+    sfree(sb);
+    return NULL;
+  }
+  send_buffer_reset(sb);
+#if HAVE_ZLIB
+  if (sending_sockets_compressed_num > 0) {
+    sb->zb = send_zbuffer_create();
+    if (sb->zb == NULL) {
+      sfree(sb->buffer);
+      sfree(sb);
+      return NULL;
+    }
+  }
+#endif
+  if (network_config_reorder_window > 0) {
+    sb->window = calloc(network_config_reorder_window, sizeof(*sb->window));
+    sb->window_sorted =
+        calloc(network_config_reorder_window, sizeof(*sb->window_sorted));
+    if ((sb->window == NULL) || (sb->window_sorted == NULL)) {
+      ERROR("network plugin: calloc failed.");
+      sfree(sb->window);
+      sfree(sb->window_sorted);
+#if HAVE_ZLIB
+      send_zbuffer_destroy(sb->zb);
+#endif
+      sfree(sb->buffer);
+      sfree(sb);
+      return NULL;
+    }
+  }
+  pthread_mutex_init(&sb->lock, /* attr = */ NULL);
+
+  /* The buffers are owned by the list, which is freed at shutdown, after the
+   * write threads are gone. */
+  pthread_mutex_lock(&send_buffers_lock);
+  sb->next = send_buffers;
+  send_buffers = sb;
+  pthread_mutex_unlock(&send_buffers_lock);
+
+  pthread_setspecific(send_buffer_key, sb);
+  return sb;
+} /* }}} send_buffer_t *send_buffer_get */
+
+static int stream_client_create(sockent_t *se) /* {{{ */
+{
+  struct stream_client_s *sc = calloc(1, sizeof(*sc));
+  if (sc == NULL) {
+    ERROR("network plugin: calloc failed.");
+    return -1;
+  }
+
+  sc->buffer = malloc(STREAM_BUFFER_SIZE);
+  sc->out = malloc(STREAM_BUFFER_SIZE);
+  if ((sc->buffer == NULL) || (sc->out == NULL)) {
+    ERROR("network plugin: malloc failed.");
+    sfree(sc->buffer);
+    sfree(sc->out);
+    sfree(sc);
+    return -1;
+  }
+  pthread_cond_init(&sc->cond, /* attr = */ NULL);
+
+  se->data.client.stream = sc;
+  return 0;
+} /* }}} int stream_client_create */
+
+/* Opens the TCP connection to the server. Only called by the stream thread,
+ * which owns the file descriptor. */
+static int stream_client_connect(sockent_t *se) /* {{{ */
+{
+  static c_complain_t complaint = C_COMPLAIN_INIT_STATIC;
+
+  struct sockent_client *client = &se->data.client;
+  struct addrinfo *ai_list;
+
+  struct addrinfo ai_hints = {.ai_family = AF_UNSPEC,
+                              .ai_flags = AI_ADDRCONFIG,
+                              .ai_protocol = IPPROTO_TCP,
+                              .ai_socktype = SOCK_STREAM};
+
+  int status = getaddrinfo(
+      se->node, (se->service != NULL) ? se->service : NET_DEFAULT_PORT,
+      &ai_hints, &ai_list);
+  if (status != 0) {
+    c_complain(
+        LOG_ERR, &complaint, "network plugin: getaddrinfo (%s, %s) failed: %s",
+        (se->node == NULL) ? "(null)" : se->node,
+        (se->service == NULL) ? "(null)" : se->service, gai_strerror(status));
+    return -1;
+  }
+
+  for (struct addrinfo *ai_ptr = ai_list; ai_ptr != NULL;
+       ai_ptr = ai_ptr->ai_next) {
+    client->fd =
+        socket(ai_ptr->ai_family, ai_ptr->ai_socktype, ai_ptr->ai_protocol);
+    if (client->fd < 0) {
+      ERROR("network plugin: socket(2) failed: %s", STRERRNO);
+      continue;
+    }
+
+    /* Also limits the time connect(2) may take. */
+    struct timeval timeout = {.tv_sec = STREAM_SEND_TIMEOUT};
+    setsockopt(client->fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    network_set_ttl(se, ai_ptr);
+    network_set_interface(se, ai_ptr);
+    network_bind_socket_to_addr(se, ai_ptr);
+
+    if (connect(client->fd, ai_ptr->ai_addr, ai_ptr->ai_addrlen) != 0) {
+      c_complain(LOG_ERR, &complaint,
+                 "network plugin: Connecting to \"%s\" failed: %s", se->node,
+                 STRERRNO);
+      close(client->fd);
+      client->fd = -1;
+      continue;
+    }
+
+#ifdef TCP_NODELAY
+    /* Frames are coalesced by the stream thread already. */
+    setsockopt(client->fd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+#endif
+
+    c_release(LOG_NOTICE, &complaint,
+              "network plugin: Successfully connected to \"%s\".", se->node);
+    break;
+  }
+
+  freeaddrinfo(ai_list);
+  if (client->fd < 0)
+    return -1;
+
+  if (client->resolve_interval > 0)
+    client->next_resolve_reconnect = cdtime() + client->resolve_interval;
+  return 0;
+} /* }}} int stream_client_connect */
+
+static int stream_client_write(int fd, const char *buffer, /* {{{ */
+                               size_t buffer_size) {
+  while (buffer_size > 0) {
+    ssize_t status = send(fd, buffer, buffer_size, MSG_NOSIGNAL);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+
+    buffer += status;
+    buffer_size -= (size_t)status;
+  }
+
+  return 0;
+} /* }}} int stream_client_write */
+
+/* Connects to the server and writes the frames queued by
+ * network_send_buffer_stream(). Reconnects, waiting longer after every
+ * failure, when the connection is lost. */
+static void *stream_client_thread(void *arg) /* {{{ */
+{
+  sockent_t *se = arg;
+  struct sockent_client *client = &se->data.client;
+  struct stream_client_s *sc = client->stream;
+  cdtime_t retry_interval = TIME_T_TO_CDTIME_T(1);
+
+  pthread_mutex_lock(&se->lock);
+  while (42) {
+    while (!sc->stop && (sc->fill == 0))
+      pthread_cond_wait(&sc->cond, &se->lock);
+
+    if (!sc->connected) {
+      if (sc->stop)
+        break;
+
+      pthread_mutex_unlock(&se->lock);
+      int status = stream_client_connect(se);
+      pthread_mutex_lock(&se->lock);
+
+      if (status != 0) {
+        /* New frames wake us up, too. Wait for the full interval anyway. */
+        struct timespec ts = CDTIME_T_TO_TIMESPEC(cdtime() + retry_interval);
+        while (!sc->stop &&
+               (pthread_cond_timedwait(&sc->cond, &se->lock, &ts) == 0))
+          /* continue waiting */;
+        if (retry_interval < TIME_T_TO_CDTIME_T(60))
+          retry_interval *= 2;
+        continue;
+      }
+
+      sc->connected = true;
+      retry_interval = TIME_T_TO_CDTIME_T(1);
+    }
+
+    if (sc->fill == 0) /* and sc->stop */
+      break;
+
+    char *out = sc->buffer;
+    size_t out_size = sc->fill;
+    sc->buffer = sc->out;
+    sc->out = out;
+    sc->fill = 0;
+    pthread_cond_broadcast(&sc->cond);
+    pthread_mutex_unlock(&se->lock);
+
+    int status = stream_client_write(client->fd, out, out_size);
+    if (status != 0)
+      ERROR("network plugin: Writing to \"%s\" failed: %s. Closing the "
+            "connection.",
+            se->node, STRERRNO);
+
+    pthread_mutex_lock(&se->lock);
+    if ((status != 0) || ((client->resolve_interval > 0) &&
+                          (client->next_resolve_reconnect < cdtime()))) {
+      close(client->fd);
+      client->fd = -1;
+      sc->connected = false;
+      /* Writers waiting for room drop their frames now. */
+      pthread_cond_broadcast(&sc->cond);
+    }
+  } /* while (42) */
+  pthread_mutex_unlock(&se->lock);
+
+  return NULL;
+} /* }}} void *stream_client_thread */
+
+/* Queues a packet for the stream thread. While the connection is up, waits
+ * for room, so that a slow server slows down the write threads instead of
+ * losing data. The caller must hold `se->lock'. */
+static void network_send_buffer_stream(sockent_t *se, /* {{{ */
+                                       const char *buffer,
+                                       size_t buffer_size) {
+  static c_complain_t complaint = C_COMPLAIN_INIT_STATIC;
+
+  struct stream_client_s *sc = se->data.client.stream;
+  size_t frame_size = STREAM_FRAME_HEADER_SIZE + buffer_size;
+
+  while (sc->connected && !sc->stop &&
+         (sc->fill + frame_size > STREAM_BUFFER_SIZE))
+    pthread_cond_wait(&sc->cond, &se->lock);
+
+  if (sc->fill + frame_size > STREAM_BUFFER_SIZE) {
+    c_complain(LOG_WARNING, &complaint,
+               "network plugin: Not connected to \"%s\". Dropping packets.",
+               se->node);
+    return;
+  }
+  c_release(LOG_NOTICE, &complaint,
+            "network plugin: Sending packets to \"%s\" again.", se->node);
+
+  uint32_t tmp = htonl((uint32_t)buffer_size);
+  memcpy(sc->buffer + sc->fill, &tmp, sizeof(tmp));
+  memcpy(sc->buffer + sc->fill + STREAM_FRAME_HEADER_SIZE, buffer,
+         buffer_size);
+  sc->fill += frame_size;
+
+  pthread_cond_broadcast(&sc->cond);
+} /* }}} void network_send_buffer_stream */
+
+static void network_send_buffer_plain(sockent_t *se, /* {{{ */
+                                      const char *buffer, size_t buffer_size) {
+  int status;
+
+  if (se->socktype == SOCK_STREAM) {
+    network_send_buffer_stream(se, buffer, buffer_size);
+    return;
+  }
+
+  while (42) {
+    status = sockent_client_connect(se);
+    if (status != 0)
+      return;
+
+    status = sendto(se->data.client.fd, buffer, buffer_size,
+                    /* flags = */ 0, (struct sockaddr *)se->data.client.addr,
+                    se->data.client.addrlen);
+    if (status < 0) {
+      if ((errno == EINTR) || (errno == EAGAIN))
+        continue;
+
+      ERROR("network plugin: sendto failed: %s. Closing sending socket.",
+            STRERRNO);
+      sockent_client_disconnect(se);
+      return;
+    }
+
+    break;
+  } /* while (42) */
+} /* }}} void network_send_buffer_plain */
+
+#if HAVE_GCRYPT_H
+#define BUFFER_ADD(p, s)                                                       \
+  do {                                                                         \
+    memcpy(buffer + buffer_offset, (p), (s));                                  \
+    buffer_offset += (s);                                                      \
+  } while (0)
+
+static void network_send_buffer_signed(sockent_t *se, /* {{{ */
+                                       const char *in_buffer,
+                                       size_t in_buffer_size) {
+  char buffer[BUFF_SIG_SIZE + in_buffer_size];
+  size_t buffer_offset;
+  size_t username_len;
+
+  gcry_md_hd_t hd;
+  gcry_error_t err;
+  unsigned char *hash;
+
+  hd = NULL;
+  err = gcry_md_open(&hd, GCRY_MD_SHA256, GCRY_MD_FLAG_HMAC);
+  if (err != 0) {
+    ERROR("network plugin: Creating HMAC object failed: %s",
+          gcry_strerror(err));
+    return;
+  }
+
+  err = gcry_md_setkey(hd, se->data.client.password,
+                       strlen(se->data.client.password));
+  if (err != 0) {
+    ERROR("network plugin: gcry_md_setkey failed: %s", gcry_strerror(err));
+    gcry_md_close(hd);
+    return;
+  }
+
+  username_len = strlen(se->data.client.username);
+  if (username_len > (BUFF_SIG_SIZE - PART_SIGNATURE_SHA256_SIZE)) {
+    ERROR("network plugin: Username too long: %s", se->data.client.username);
+    return;
+  }
+
+  memcpy(buffer + PART_SIGNATURE_SHA256_SIZE, se->data.client.username,
+         username_len);
+  memcpy(buffer + PART_SIGNATURE_SHA256_SIZE + username_len, in_buffer,
+         in_buffer_size);
+
+  /* Initialize the `ps' structure. */
+  part_signature_sha256_t ps = {
       .head.type = htons(TYPE_SIGN_SHA256),
       .head.length = htons(PART_SIGNATURE_SHA256_SIZE + username_len)};
 
@@ -2574,13 +4088,157 @@ static void network_send_buffer_encrypted(sockent_t *se, /* {{{ */
 #undef BUFFER_ADD
 #endif /* HAVE_GCRYPT_H */
 
-static void network_send_buffer(char *buffer, size_t buffer_len) /* {{{ */
+#if HAVE_SENDMMSG
+/* Maximum number of servers a plain packet is sent to with one sendmmsg(2). */
+#define SEND_FANOUT_MAX 32
+
+struct send_fanout {
+  sockent_t *se;
+  struct sockaddr_storage addr;
+  socklen_t addrlen;
+  bool multicast;
+  bool done;
+};
+
+/* Sockets without an interface or a bind address only differ in the TTL
+ * option, which is the same for all destinations of one family and kind. A
+ * packet for any of those servers can be sent through any of these sockets. */
+static bool sockent_client_is_shareable(const sockent_t *se) /* {{{ */
 {
+  return (se->socktype == SOCK_DGRAM) && (se->interface == 0) &&
+         (se->data.client.bind_addr == NULL);
+} /* }}} bool sockent_client_is_shareable */
+
+static bool sockaddr_is_multicast(const struct sockaddr_storage *ss) /* {{{ */
+{
+  if (ss->ss_family == AF_INET) {
+    const struct sockaddr_in *addr = (const struct sockaddr_in *)ss;
+    return IN_MULTICAST(ntohl(addr->sin_addr.s_addr));
+  } else if (ss->ss_family == AF_INET6) {
+    const struct sockaddr_in6 *addr = (const struct sockaddr_in6 *)ss;
+    return IN6_IS_ADDR_MULTICAST(&addr->sin6_addr);
+  }
+  return false;
+} /* }}} bool sockaddr_is_multicast */
+
+/* Adds `se' to `fo' if it sends plain packets through a shareable socket. The
+ * caller must hold `se->lock'. */
+static bool send_fanout_add(struct send_fanout *fo, size_t *fo_num, /* {{{ */
+                            sockent_t *se) {
+#if HAVE_GCRYPT_H
+  if (se->data.client.security_level != SECURITY_LEVEL_NONE)
+    return false;
+#endif
+  if ((*fo_num >= SEND_FANOUT_MAX) || !sockent_client_is_shareable(se))
+    return false;
+  /* Like network_send_buffer_plain(), drop the packet if this fails. */
+  if (sockent_client_connect(se) != 0)
+    return true;
+
+  struct send_fanout *f = fo + *fo_num;
+  *f = (struct send_fanout){
+      .se = se,
+      .addrlen = se->data.client.addrlen,
+  };
+  memcpy(&f->addr, se->data.client.addr, se->data.client.addrlen);
+  f->multicast = sockaddr_is_multicast(&f->addr);
+  (*fo_num)++;
+
+  return true;
+} /* }}} bool send_fanout_add */
+
+/* Sends the same packet to all servers in `fo' using one sendmmsg(2) per
+ * group of compatible destinations. The socket of the first server of a group
+ * is used for the whole group. Servers the batch failed for are retried with
+ * their own socket. */
+static void network_send_buffer_fanout(struct send_fanout *fo, /* {{{ */
+                                       size_t fo_num, const char *buffer,
+                                       size_t buffer_size) {
+  struct mmsghdr msgs[SEND_FANOUT_MAX];
+  struct send_fanout *group[SEND_FANOUT_MAX];
+  struct iovec iov = {.iov_base = (void *)buffer, .iov_len = buffer_size};
+
+  for (size_t i = 0; i < fo_num; i++) {
+    if (fo[i].done)
+      continue;
+
+    size_t group_num = 0;
+    for (size_t j = i; j < fo_num; j++) {
+      if (fo[j].done || (fo[j].addr.ss_family != fo[i].addr.ss_family) ||
+          (fo[j].multicast != fo[i].multicast))
+        continue;
+
+      msgs[group_num] = (struct mmsghdr){
+          .msg_hdr =
+              {
+                  .msg_name = &fo[j].addr,
+                  .msg_namelen = fo[j].addrlen,
+                  .msg_iov = &iov,
+                  .msg_iovlen = 1,
+              },
+      };
+      group[group_num] = fo + j;
+      group_num++;
+    }
+
+    sockent_t *owner = fo[i].se;
+    int sent = 0;
+
+    pthread_mutex_lock(&owner->lock);
+    while ((owner->data.client.fd >= 0) && ((size_t)sent < group_num)) {
+      int status = sendmmsg(owner->data.client.fd, msgs + sent,
+                            (unsigned int)(group_num - sent), /* flags = */ 0);
+      if (status < 0) {
+        if ((errno == EINTR) || (errno == EAGAIN))
+          continue;
+        ERROR("network plugin: sendmmsg failed: %s. Closing sending socket.",
+              STRERRNO);
+        sockent_client_disconnect(owner);
+        break;
+      }
+      sent += status;
+    }
+    pthread_mutex_unlock(&owner->lock);
+
+    for (size_t j = 0; j < group_num; j++)
+      group[j]->done = true;
+
+    /* Fall back to sending one by one if the batch failed. */
+    for (size_t j = (size_t)sent; j < group_num; j++) {
+      pthread_mutex_lock(&group[j]->se->lock);
+      network_send_buffer_plain(group[j]->se, buffer, buffer_size);
+      pthread_mutex_unlock(&group[j]->se->lock);
+    }
+  }
+} /* }}} void network_send_buffer_fanout */
+#endif /* HAVE_SENDMMSG */
+
+/* Sends a packet to the servers selected by `dest', one of the SEND_TO_*
+ * constants. */
+static void network_send_buffer_now(char *buffer, size_t buffer_len, /* {{{ */
+                                    int dest) {
+#if HAVE_SENDMMSG
+  struct send_fanout fo[SEND_FANOUT_MAX];
+  size_t fo_num = 0;
+#endif
+
   DEBUG("network plugin: network_send_buffer: buffer_len = %" PRIsz,
         buffer_len);
 
   for (sockent_t *se = sending_sockets; se != NULL; se = se->next) {
+    if (((dest == SEND_TO_PLAIN) && se->data.client.compress) ||
+        ((dest == SEND_TO_COMPRESSED) && !se->data.client.compress))
+      continue;
+
     pthread_mutex_lock(&se->lock);
+#if HAVE_SENDMMSG
+    /* Plain packets are the same for all servers. Collect them and send them
+     * with as few system calls as possible below. */
+    if (send_fanout_add(fo, &fo_num, se)) {
+      pthread_mutex_unlock(&se->lock);
+      continue;
+    }
+#endif
 #if HAVE_GCRYPT_H
     if (se->data.client.security_level == SECURITY_LEVEL_ENCRYPT)
       network_send_buffer_encrypted(se, buffer, buffer_len);
@@ -2591,6 +4249,135 @@ static void network_send_buffer(char *buffer, size_t buffer_len) /* {{{ */
       network_send_buffer_plain(se, buffer, buffer_len);
     pthread_mutex_unlock(&se->lock);
   } /* for (sending_sockets) */
+
+#if HAVE_SENDMMSG
+  if (fo_num == 1) {
+    pthread_mutex_lock(&fo[0].se->lock);
+    network_send_buffer_plain(fo[0].se, buffer, buffer_len);
+    pthread_mutex_unlock(&fo[0].se->lock);
+  } else if (fo_num > 1) {
+    network_send_buffer_fanout(fo, fo_num, buffer, buffer_len);
+  }
+#endif
+} /* }}} void network_send_buffer_now */
+
+/* Returns the time a packet created at `now' is due: the next time that is
+ * `send_pace_offset' into an interval. */
+static cdtime_t send_pace_due(cdtime_t now) /* {{{ */
+{
+  if (!network_config_send_spread || (send_pace_interval == 0))
+    return now;
+
+  cdtime_t due = now - (now % send_pace_interval) + send_pace_offset;
+  if (due < now)
+    due += send_pace_interval;
+  return due;
+} /* }}} cdtime_t send_pace_due */
+
+/* Sends the queued packets once they are due, limiting the rate with a token
+ * bucket of `network_config_send_burst' packets. When stopping, the remaining
+ * packets are sent right away. */
+static void *send_pace_thread(void __attribute__((unused)) * arg) /* {{{ */
+{
+  double rate = network_config_send_rate;
+  double burst = (double)network_config_send_burst;
+  double tokens = burst;
+  cdtime_t last = cdtime();
+
+  pthread_mutex_lock(&send_pace_lock);
+  while (42) {
+    while (!send_pace_stop && (send_pace_head == NULL))
+      pthread_cond_wait(&send_pace_cond, &send_pace_lock);
+
+    send_paced_t *p = send_pace_head;
+    if (p == NULL) /* and send_pace_stop */
+      break;
+
+    cdtime_t now = cdtime();
+    cdtime_t wait_until = 0;
+    if (send_pace_stop) {
+      /* send everything */
+    } else if (p->due > now) {
+      wait_until = p->due;
+    } else if (rate > 0.0) {
+      tokens += CDTIME_T_TO_DOUBLE(now - last) * rate;
+      if (tokens > burst)
+        tokens = burst;
+      last = now;
+      if (tokens < 1.0)
+        wait_until = now + DOUBLE_TO_CDTIME_T((1.0 - tokens) / rate);
+      else
+        tokens -= 1.0;
+    }
+
+    if (wait_until != 0) {
+      struct timespec ts = CDTIME_T_TO_TIMESPEC(wait_until);
+      pthread_cond_timedwait(&send_pace_cond, &send_pace_lock, &ts);
+      continue;
+    }
+
+    send_pace_head = p->next;
+    if (send_pace_head == NULL)
+      send_pace_tail = NULL;
+    send_pace_num--;
+    pthread_mutex_unlock(&send_pace_lock);
+
+    network_send_buffer_now(p->data, p->len, p->dest);
+    sfree(p);
+
+    pthread_mutex_lock(&send_pace_lock);
+  }
+  pthread_mutex_unlock(&send_pace_lock);
+
+  return NULL;
+} /* }}} void *send_pace_thread */
+
+/* Sends a packet right away or, if pacing is enabled, queues it for the
+ * pacing thread. */
+static void network_send_buffer(char *buffer, size_t buffer_len, /* {{{ */
+                                int dest) {
+  static c_complain_t complain_full = C_COMPLAIN_INIT_STATIC;
+
+  if (!send_pace_thread_running) {
+    network_send_buffer_now(buffer, buffer_len, dest);
+    return;
+  }
+
+  send_paced_t *p = malloc(sizeof(*p) + buffer_len);
+  if (p == NULL) {
+    ERROR("network plugin: network_send_buffer: malloc failed.");
+    return;
+  }
+  p->next = NULL;
+  p->dest = dest;
+  p->len = buffer_len;
+  memcpy(p->data, buffer, buffer_len);
+
+  pthread_mutex_lock(&send_pace_lock);
+  if (send_pace_num >= SEND_PACE_QUEUE_MAX) {
+    pthread_mutex_unlock(&send_pace_lock);
+    sfree(p);
+    c_complain(LOG_WARNING, &complain_full,
+               "network plugin: %d packets are waiting to be sent, dropping "
+               "new ones. Consider increasing `SendRate'.",
+               SEND_PACE_QUEUE_MAX);
+    return;
+  }
+
+  /* Due times never decrease, so the queue stays sorted. */
+  p->due = send_pace_due(cdtime());
+  if (send_pace_tail == NULL)
+    send_pace_head = p;
+  else
+    send_pace_tail->next = p;
+  send_pace_tail = p;
+  send_pace_num++;
+  if (send_pace_head == p)
+    pthread_cond_signal(&send_pace_cond);
+  pthread_mutex_unlock(&send_pace_lock);
+
+  c_release(LOG_INFO, &complain_full,
+            "network plugin: Packets are queued for sending again.");
 } /* }}} void network_send_buffer */
 
 static int add_to_buffer(char *buffer, size_t buffer_size, /* {{{ */
@@ -2598,75 +4385,340 @@ static int add_to_buffer(char *buffer, size_t buffer_size, /* {{{ */
                          const value_list_t *vl) {
   char *buffer_orig = buffer;
 
-  if (strcmp(vl_def->host, vl->host) != 0) {
-    if (write_part_string(&buffer, &buffer_size, TYPE_HOST, vl->host,
-                          strlen(vl->host)) != 0)
-      return -1;
-    sstrncpy(vl_def->host, vl->host, sizeof(vl_def->host));
-  }
+  if (strcmp(vl_def->host, vl->host) != 0) {
+    if (write_part_string(&buffer, &buffer_size, TYPE_HOST, vl->host,
+                          strlen(vl->host)) != 0)
+      return -1;
+    sstrncpy(vl_def->host, vl->host, sizeof(vl_def->host));
+  }
+
+  if (vl_def->time != vl->time) {
+    if (write_part_number(&buffer, &buffer_size, TYPE_TIME_HR,
+                          (uint64_t)vl->time))
+      return -1;
+    vl_def->time = vl->time;
+  }
+
+  if (vl_def->interval != vl->interval) {
+    if (write_part_number(&buffer, &buffer_size, TYPE_INTERVAL_HR,
+                          (uint64_t)vl->interval))
+      return -1;
+    vl_def->interval = vl->interval;
+  }
+
+  if (strcmp(vl_def->plugin, vl->plugin) != 0) {
+    if (write_part_string(&buffer, &buffer_size, TYPE_PLUGIN, vl->plugin,
+                          strlen(vl->plugin)) != 0)
+      return -1;
+    sstrncpy(vl_def->plugin, vl->plugin, sizeof(vl_def->plugin));
+  }
+
+  if (strcmp(vl_def->plugin_instance, vl->plugin_instance) != 0) {
+    if (write_part_string(&buffer, &buffer_size, TYPE_PLUGIN_INSTANCE,
+                          vl->plugin_instance,
+                          strlen(vl->plugin_instance)) != 0)
+      return -1;
+    sstrncpy(vl_def->plugin_instance, vl->plugin_instance,
+             sizeof(vl_def->plugin_instance));
+  }
+
+  if (strcmp(vl_def->type, vl->type) != 0) {
+    if (write_part_string(&buffer, &buffer_size, TYPE_TYPE, vl->type,
+                          strlen(vl->type)) != 0)
+      return -1;
+    sstrncpy(vl_def->type, ds->type, sizeof(vl_def->type));
+  }
+
+  if (strcmp(vl_def->type_instance, vl->type_instance) != 0) {
+    if (write_part_string(&buffer, &buffer_size, TYPE_TYPE_INSTANCE,
+                          vl->type_instance, strlen(vl->type_instance)) != 0)
+      return -1;
+    sstrncpy(vl_def->type_instance, vl->type_instance,
+             sizeof(vl_def->type_instance));
+  }
+
+  if (write_part_values(&buffer, &buffer_size, ds, vl) != 0)
+    return -1;
+
+  return buffer - buffer_orig;
+} /* }}} int add_to_buffer */
+
+/* Sends the packet in `sb'. The caller must hold `sb->lock'. */
+static void flush_buffer(send_buffer_t *sb) {
+  DEBUG("network plugin: flush_buffer: fill = %i", sb->fill);
+
+  network_send_buffer(sb->buffer, (size_t)sb->fill, SEND_TO_PLAIN);
+
+  __atomic_fetch_add(&stats_octets_tx, (derive_t)sb->fill, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&stats_packets_tx, 1, __ATOMIC_RELAXED);
+
+  send_buffer_reset(sb);
+}
+
+/* Adds `vl' to the plain packet in `sb', sending the packet when it is full.
+ * The caller must hold `sb->lock'. */
+static int send_buffer_add(send_buffer_t *sb, const data_set_t *ds, /* {{{ */
+                           const value_list_t *vl) {
+  int status = add_to_buffer(
+      sb->ptr, network_config_packet_size - (sb->fill + BUFF_SIG_SIZE),
+      &sb->vl, ds, vl);
+  if (status < 0) {
+    flush_buffer(sb);
+
+    status = add_to_buffer(
+        sb->ptr, network_config_packet_size - (sb->fill + BUFF_SIG_SIZE),
+        &sb->vl, ds, vl);
+    if (status < 0)
+      return -1;
+  }
+
+  /* status == bytes added to the buffer */
+  sb->fill += status;
+  sb->ptr += status;
+
+  if ((network_config_packet_size - sb->fill) < 15)
+    flush_buffer(sb);
+
+  return 0;
+} /* }}} int send_buffer_add */
+
+#if HAVE_ZLIB
+/* Returns how many bytes of parts may be added to `zb->pending' without
+ * risking that the compressed packet overflows. */
+static size_t send_zbuffer_room(const send_zbuffer_t *zb) /* {{{ */
+{
+  size_t size = network_config_packet_size - BUFF_SIG_SIZE;
+  size_t used = sizeof(part_header_t) + (size_t)zb->stream.total_out +
+                zb->pending_fill + COMPR_STREAM_OVERHEAD + COMPR_FLUSH_OVERHEAD;
+
+  return (used < size) ? (size - used) : 0;
+} /* }}} size_t send_zbuffer_room */
+
+/* Compresses the pending parts. `flush' is either Z_SYNC_FLUSH or Z_FINISH. */
+static int send_zbuffer_deflate(send_zbuffer_t *zb, int flush) /* {{{ */
+{
+  size_t size = network_config_packet_size - BUFF_SIG_SIZE;
+  size_t offset = sizeof(part_header_t) + (size_t)zb->stream.total_out;
+
+  zb->stream.next_in = (Bytef *)zb->pending;
+  zb->stream.avail_in = (uInt)zb->pending_fill;
+  zb->stream.next_out = (Bytef *)(zb->packet + offset);
+  zb->stream.avail_out = (uInt)(size - offset);
+
+  int status = deflate(&zb->stream, flush);
+  if ((zb->stream.avail_in != 0) ||
+      (status != ((flush == Z_FINISH) ? Z_STREAM_END : Z_OK))) {
+    ERROR("network plugin: deflate failed with status %i.", status);
+    return -1;
+  }
+
+  zb->pending_fill = 0;
+  return 0;
+} /* }}} int send_zbuffer_deflate */
+
+/* Sends the compressed packet in `zb'. The caller must hold the lock of the
+ * send buffer `zb' belongs to. */
+static void flush_zbuffer(send_zbuffer_t *zb) /* {{{ */
+{
+  if ((zb->stream.total_out == 0) && (zb->pending_fill == 0))
+    return;
+
+  if (send_zbuffer_deflate(zb, Z_FINISH) == 0) {
+    size_t packet_size = sizeof(part_header_t) + (size_t)zb->stream.total_out;
+    uint16_t pkg_type = htons(TYPE_COMPR_ZLIB);
+    uint16_t pkg_length = htons((uint16_t)packet_size);
+
+    DEBUG("network plugin: flush_zbuffer: %lu bytes compressed to %" PRIsz,
+          zb->stream.total_in, packet_size);
+
+    memcpy(zb->packet, &pkg_type, sizeof(pkg_type));
+    memcpy(zb->packet + sizeof(pkg_type), &pkg_length, sizeof(pkg_length));
+    network_send_buffer(zb->packet, packet_size, SEND_TO_COMPRESSED);
+
+    __atomic_fetch_add(&stats_octets_tx, (derive_t)packet_size,
+                       __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats_packets_tx, 1, __ATOMIC_RELAXED);
+  }
+
+  send_zbuffer_reset(zb);
+} /* }}} void flush_zbuffer */
+
+/* Adds `vl' to the compressed packet in `zb', sending the packet when it is
+ * full. The caller must hold the lock of the send buffer `zb' belongs to. */
+static int send_zbuffer_add(send_zbuffer_t *zb, const data_set_t *ds, /* {{{ */
+                            const value_list_t *vl) {
+  while (42) {
+    /* add_to_buffer() updates the identifier as it goes, even if it fails. */
+    value_list_t vl_def = zb->vl;
+
+    int status = add_to_buffer(zb->pending + zb->pending_fill,
+                               send_zbuffer_room(zb), &zb->vl, ds, vl);
+    if (status >= 0) {
+      zb->pending_fill += (size_t)status;
+      return 0;
+    }
+    zb->vl = vl_def;
+
+    if (zb->pending_fill > 0) {
+      /* Compressing the pending parts makes room for more. */
+      if (send_zbuffer_deflate(zb, Z_SYNC_FLUSH) != 0) {
+        send_zbuffer_reset(zb);
+        return -1;
+      }
+    } else if (zb->stream.total_out > 0) {
+      flush_zbuffer(zb);
+    } else {
+      /* Does not even fit into an empty packet. */
+      return -1;
+    }
+  }
+} /* }}} int send_zbuffer_add */
+#endif /* HAVE_ZLIB */
+
+/* Adds `vl' to the plain and the compressed packet, as required by the
+ * servers. The caller must hold `sb->lock'. */
+static int send_buffer_add_all(send_buffer_t *sb, /* {{{ */
+                               const data_set_t *ds, const value_list_t *vl) {
+  int status = 0;
+
+  if (sending_sockets_plain_num > 0)
+    status = send_buffer_add(sb, ds, vl);
+#if HAVE_ZLIB
+  if ((status == 0) && (sb->zb != NULL))
+    status = send_zbuffer_add(sb->zb, ds, vl);
+#endif
+
+  return status;
+} /* }}} int send_buffer_add_all */
+
+/* Orders value lists so that those sharing the most parts are adjacent. The
+ * order of value lists with the same identifier is kept by comparing the time
+ * before the type instance. */
+static int send_window_compare(const void *a, const void *b) /* {{{ */
+{
+  const value_list_t *vl_a = &(*(send_window_entry_t *const *)a)->vl;
+  const value_list_t *vl_b = &(*(send_window_entry_t *const *)b)->vl;
+  int status;
+
+  if ((status = strcmp(vl_a->host, vl_b->host)) != 0)
+    return status;
+  if ((status = strcmp(vl_a->plugin, vl_b->plugin)) != 0)
+    return status;
+  if ((status = strcmp(vl_a->plugin_instance, vl_b->plugin_instance)) != 0)
+    return status;
+  if ((status = strcmp(vl_a->type, vl_b->type)) != 0)
+    return status;
+  if (vl_a->time != vl_b->time)
+    return (vl_a->time < vl_b->time) ? -1 : 1;
+  if (vl_a->interval != vl_b->interval)
+    return (vl_a->interval < vl_b->interval) ? -1 : 1;
+  return strcmp(vl_a->type_instance, vl_b->type_instance);
+} /* }}} int send_window_compare */
+
+/* Sorts the value lists in the reorder window and adds them to the packets.
+ * The caller must hold `sb->lock'. */
+static int send_window_flush(send_buffer_t *sb) /* {{{ */
+{
+  int status = 0;
+
+  if (sb->window_num == 0)
+    return 0;
 
-  if (vl_def->time != vl->time) {
-    if (write_part_number(&buffer, &buffer_size, TYPE_TIME_HR,
-                          (uint64_t)vl->time))
-      return -1;
-    vl_def->time = vl->time;
-  }
+  for (size_t i = 0; i < sb->window_num; i++)
+    sb->window_sorted[i] = sb->window + i;
+  qsort(sb->window_sorted, sb->window_num, sizeof(*sb->window_sorted),
+        send_window_compare);
 
-  if (vl_def->interval != vl->interval) {
-    if (write_part_number(&buffer, &buffer_size, TYPE_INTERVAL_HR,
-                          (uint64_t)vl->interval))
-      return -1;
-    vl_def->interval = vl->interval;
+  for (size_t i = 0; i < sb->window_num; i++) {
+    send_window_entry_t *e = sb->window_sorted[i];
+    if (send_buffer_add_all(sb, e->ds, &e->vl) != 0)
+      status = -1;
   }
+  sb->window_num = 0;
 
-  if (strcmp(vl_def->plugin, vl->plugin) != 0) {
-    if (write_part_string(&buffer, &buffer_size, TYPE_PLUGIN, vl->plugin,
-                          strlen(vl->plugin)) != 0)
-      return -1;
-    sstrncpy(vl_def->plugin, vl->plugin, sizeof(vl_def->plugin));
-  }
+  return status;
+} /* }}} int send_window_flush */
 
-  if (strcmp(vl_def->plugin_instance, vl->plugin_instance) != 0) {
-    if (write_part_string(&buffer, &buffer_size, TYPE_PLUGIN_INSTANCE,
-                          vl->plugin_instance,
-                          strlen(vl->plugin_instance)) != 0)
-      return -1;
-    sstrncpy(vl_def->plugin_instance, vl->plugin_instance,
-             sizeof(vl_def->plugin_instance));
-  }
+/* Copies `vl' into the reorder window, flushing the window when it is full.
+ * The caller must hold `sb->lock'. */
+static int send_window_add(send_buffer_t *sb, /* {{{ */
+                           const data_set_t *ds, const value_list_t *vl) {
+  send_window_entry_t *e = sb->window + sb->window_num;
 
-  if (strcmp(vl_def->type, vl->type) != 0) {
-    if (write_part_string(&buffer, &buffer_size, TYPE_TYPE, vl->type,
-                          strlen(vl->type)) != 0)
+  if (e->values_size < vl->values_len) {
+    value_t *tmp = realloc(e->values, vl->values_len * sizeof(*tmp));
+    if (tmp == NULL) {
+      ERROR("network plugin: realloc failed.");
       return -1;
-    sstrncpy(vl_def->type, ds->type, sizeof(vl_def->type));
+    }
+    e->values = tmp;
+    e->values_size = vl->values_len;
   }
 
-  if (strcmp(vl_def->type_instance, vl->type_instance) != 0) {
-    if (write_part_string(&buffer, &buffer_size, TYPE_TYPE_INSTANCE,
-                          vl->type_instance, strlen(vl->type_instance)) != 0)
-      return -1;
-    sstrncpy(vl_def->type_instance, vl->type_instance,
-             sizeof(vl_def->type_instance));
-  }
+  e->ds = ds;
+  memcpy(&e->vl, vl, sizeof(e->vl));
+  memcpy(e->values, vl->values, vl->values_len * sizeof(*e->values));
+  e->vl.values = e->values;
+  /* Meta data is not sent. */
+  e->vl.meta = NULL;
+  sb->window_num++;
 
-  if (write_part_values(&buffer, &buffer_size, ds, vl) != 0)
-    return -1;
+  if (sb->window_num >= network_config_reorder_window)
+    return send_window_flush(sb);
+  return 0;
+} /* }}} int send_window_add */
 
-  return buffer - buffer_orig;
-} /* }}} int add_to_buffer */
+static bool send_buffer_is_empty(const send_buffer_t *sb) /* {{{ */
+{
+  if (sb->window_num > 0)
+    return false;
+#if HAVE_ZLIB
+  if ((sb->zb != NULL) &&
+      ((sb->zb->stream.total_out > 0) || (sb->zb->pending_fill > 0)))
+    return false;
+#endif
+  return sb->fill == 0;
+} /* }}} bool send_buffer_is_empty */
+
+/* Sends the plain and the compressed packet in `sb'. The caller must hold
+ * `sb->lock'. */
+static void send_buffer_flush(send_buffer_t *sb) /* {{{ */
+{
+  send_window_flush(sb);
+  if (sb->fill > 0)
+    flush_buffer(sb);
+#if HAVE_ZLIB
+  if (sb->zb != NULL)
+    flush_zbuffer(sb->zb);
+#endif
+} /* }}} void send_buffer_flush */
 
-static void flush_buffer(void) {
-  DEBUG("network plugin: flush_buffer: send_buffer_fill = %i",
-        send_buffer_fill);
+static void send_buffers_destroy(void) /* {{{ */
+{
+  pthread_mutex_lock(&send_buffers_lock);
+  send_buffer_t *sb = send_buffers;
+  send_buffers = NULL;
+  pthread_mutex_unlock(&send_buffers_lock);
 
-  network_send_buffer(send_buffer, (size_t)send_buffer_fill);
+  while (sb != NULL) {
+    send_buffer_t *next = sb->next;
 
-  stats_octets_tx += ((uint64_t)send_buffer_fill);
-  stats_packets_tx++;
+    send_buffer_flush(sb);
 
-  network_init_buffer();
-}
+    pthread_mutex_destroy(&sb->lock);
+    sfree(sb->buffer);
+#if HAVE_ZLIB
+    send_zbuffer_destroy(sb->zb);
+#endif
+    for (size_t i = 0; i < network_config_reorder_window; i++)
+      if (sb->window != NULL)
+        sfree(sb->window[i].values);
+    sfree(sb->window);
+    sfree(sb->window_sorted);
+    sfree(sb);
+    sb = next;
+  }
+} /* }}} void send_buffers_destroy */
 
 static int network_write(const data_set_t *ds, const value_list_t *vl,
                          user_data_t __attribute__((unused)) * user_data) {
@@ -2688,51 +4740,32 @@ static int network_write(const data_set_t *ds, const value_list_t *vl,
 #endif
     /* Counter is not protected by another lock and may be reached by
      * multiple threads */
-    pthread_mutex_lock(&stats_lock);
-    stats_values_not_sent++;
-    pthread_mutex_unlock(&stats_lock);
+    __atomic_fetch_add(&stats_values_not_sent, 1, __ATOMIC_RELAXED);
     return 0;
   }
 
   uc_meta_data_add_unsigned_int(vl, "network:time_sent", (uint64_t)vl->time);
 
-  pthread_mutex_lock(&send_buffer_lock);
-
-  status = add_to_buffer(send_buffer_ptr,
-                         network_config_packet_size -
-                             (send_buffer_fill + BUFF_SIG_SIZE),
-                         &send_buffer_vl, ds, vl);
-  if (status >= 0) {
-    /* status == bytes added to the buffer */
-    send_buffer_fill += status;
-    send_buffer_ptr += status;
-    send_buffer_last_update = cdtime();
-
-    stats_values_sent++;
-  } else {
-    flush_buffer();
-
-    status = add_to_buffer(send_buffer_ptr,
-                           network_config_packet_size -
-                               (send_buffer_fill + BUFF_SIG_SIZE),
-                           &send_buffer_vl, ds, vl);
+  send_buffer_t *sb = send_buffer_get();
+  if (sb == NULL)
+    return -1;
 
-    if (status >= 0) {
-      send_buffer_fill += status;
-      send_buffer_ptr += status;
+  pthread_mutex_lock(&sb->lock);
 
-      stats_values_sent++;
-    }
-  }
+  if (sb->window != NULL)
+    status = send_window_add(sb, ds, vl);
+  else
+    status = send_buffer_add_all(sb, ds, vl);
 
-  if (status < 0) {
+  if (status == 0) {
+    sb->last_update = cdtime();
+    __atomic_fetch_add(&stats_values_sent, 1, __ATOMIC_RELAXED);
+  } else {
     ERROR("network plugin: Unable to append to the "
           "buffer for some weird reason");
-  } else if ((network_config_packet_size - send_buffer_fill) < 15) {
-    flush_buffer();
   }
 
-  pthread_mutex_unlock(&send_buffer_lock);
+  pthread_mutex_unlock(&sb->lock);
 
   return (status < 0) ? -1 : 0;
 } /* int network_write */
@@ -2833,6 +4866,27 @@ static int network_config_set_buffer_size(const oconfig_item_t *ci) /* {{{ */
   return 0;
 } /* }}} int network_config_set_buffer_size */
 
+static int network_config_set_protocol(const oconfig_item_t *ci, /* {{{ */
+                                       int *socktype) {
+  char *str = NULL;
+
+  if (cf_util_get_string(ci, &str) != 0)
+    return -1;
+
+  int status = 0;
+  if (strcasecmp("UDP", str) == 0)
+    *socktype = SOCK_DGRAM;
+  else if (strcasecmp("TCP", str) == 0)
+    *socktype = SOCK_STREAM;
+  else {
+    WARNING("network plugin: Unknown protocol: %s.", str);
+    status = -1;
+  }
+
+  sfree(str);
+  return status;
+} /* }}} int network_config_set_protocol */
+
 #if HAVE_GCRYPT_H
 static int network_config_set_security_level(oconfig_item_t *ci, /* {{{ */
                                              int *retval) {
@@ -2895,11 +4949,22 @@ static int network_config_add_listen(const oconfig_item_t *ci) /* {{{ */
 #endif /* HAVE_GCRYPT_H */
         if (strcasecmp("Interface", child->key) == 0)
       network_config_set_interface(child, &se->interface);
+    else if (strcasecmp("Protocol", child->key) == 0)
+      network_config_set_protocol(child, &se->socktype);
     else {
       WARNING("network plugin: Option `%s' is not allowed here.", child->key);
     }
   }
 
+#if !HAVE_SYS_EPOLL_H
+  if (se->socktype == SOCK_STREAM) {
+    ERROR("network plugin: Listening for TCP connections requires epoll(7), "
+          "which is not available on this system.");
+    sockent_destroy(se);
+    return -1;
+  }
+#endif
+
 #if HAVE_GCRYPT_H
   if ((se->data.server.security_level > SECURITY_LEVEL_NONE) &&
       (se->data.server.auth_file == NULL)) {
@@ -2911,31 +4976,187 @@ static int network_config_add_listen(const oconfig_item_t *ci) /* {{{ */
   }
 #endif /* HAVE_GCRYPT_H */
 
-  status = sockent_init_crypto(se);
-  if (status != 0) {
-    ERROR("network plugin: network_config_add_listen: sockent_init_crypto() "
-          "failed.");
+  if (receivers_create() != 0) {
     sockent_destroy(se);
     return -1;
   }
 
-  status = sockent_server_listen(se);
-  if (status != 0) {
-    ERROR("network plugin: network_config_add_listen: sockent_server_listen "
-          "failed.");
-    sockent_destroy(se);
+  /* Open one copy of the socket for every receiver. The copies share no
+   * state, so the dispatch threads never touch the same cipher. */
+  for (size_t i = 0; i < receivers_num; i++) {
+    sockent_t *copy = se;
+
+    if (i > 0) {
+      copy = sockent_server_clone(se);
+      if (copy == NULL) {
+        ERROR("network plugin: network_config_add_listen: "
+              "sockent_server_clone failed.");
+        return -1;
+      }
+    }
+    copy->data.server.receiver = i;
+
+    status = sockent_init_crypto(copy);
+    if (status != 0) {
+      ERROR("network plugin: network_config_add_listen: sockent_init_crypto() "
+            "failed.");
+      sockent_destroy(copy);
+      return -1;
+    }
+
+    status = sockent_server_listen(copy);
+    if (status != 0) {
+      ERROR("network plugin: network_config_add_listen: sockent_server_listen "
+            "failed.");
+      sockent_destroy(copy);
+      return -1;
+    }
+
+    status = sockent_add(copy);
+    if (status != 0) {
+      ERROR("network plugin: network_config_add_listen: sockent_add failed.");
+      sockent_destroy(copy);
+      return -1;
+    }
+  }
+
+  return 0;
+} /* }}} int network_config_add_listen */
+
+static int network_config_set_receive_threads(oconfig_item_t *ci) /* {{{ */
+{
+  int tmp = 0;
+
+  if (cf_util_get_int(ci, &tmp) != 0)
+    return -1;
+
+  if (tmp < 1) {
+    WARNING("network plugin: The `ReceiveThreads' option must be positive.");
     return -1;
   }
 
-  status = sockent_add(se);
-  if (status != 0) {
-    ERROR("network plugin: network_config_add_listen: sockent_add failed.");
-    sockent_destroy(se);
+#ifndef SO_REUSEPORT
+  if (tmp > 1) {
+    WARNING("network plugin: `ReceiveThreads' requires SO_REUSEPORT, which is "
+            "not available on this system. Using one receive thread.");
+    tmp = 1;
+  }
+#endif
+
+  if ((receivers != NULL) && ((size_t)tmp != receivers_num)) {
+    WARNING("network plugin: The `ReceiveThreads' option must be set before "
+            "the first `Listen' block. Keeping %" PRIsz " receive threads.",
+            receivers_num);
     return -1;
   }
 
+  network_config_receive_threads = (size_t)tmp;
   return 0;
-} /* }}} int network_config_add_listen */
+} /* }}} int network_config_set_receive_threads */
+
+static int network_config_set_reorder_window(oconfig_item_t *ci) /* {{{ */
+{
+  int tmp = 0;
+
+  if (cf_util_get_int(ci, &tmp) != 0)
+    return -1;
+
+  if (tmp < 0) {
+    WARNING("network plugin: The `ReorderWindow' option must not be "
+            "negative.");
+    return -1;
+  }
+
+  network_config_reorder_window = (size_t)tmp;
+  return 0;
+} /* }}} int network_config_set_reorder_window */
+
+static int network_config_set_send_rate(oconfig_item_t *ci) /* {{{ */
+{
+  double tmp = 0.0;
+
+  if (cf_util_get_double(ci, &tmp) != 0)
+    return -1;
+
+  if (tmp < 0.0) {
+    WARNING("network plugin: The `SendRate' option must not be negative.");
+    return -1;
+  }
+
+  network_config_send_rate = tmp;
+  return 0;
+} /* }}} int network_config_set_send_rate */
+
+static int network_config_set_send_burst(oconfig_item_t *ci) /* {{{ */
+{
+  int tmp = 0;
+
+  if (cf_util_get_int(ci, &tmp) != 0)
+    return -1;
+
+  if (tmp < 1) {
+    WARNING("network plugin: The `SendBurst' option must be positive.");
+    return -1;
+  }
+
+  network_config_send_burst = tmp;
+  return 0;
+} /* }}} int network_config_set_send_burst */
+
+static int network_config_set_relay_sample(oconfig_item_t *ci) /* {{{ */
+{
+  int tmp = 0;
+
+  if (cf_util_get_int(ci, &tmp) != 0)
+    return -1;
+
+  if (tmp < 0) {
+    WARNING("network plugin: The `RelaySample' option must not be "
+            "negative.");
+    return -1;
+  }
+
+  network_config_relay_sample = tmp;
+  return 0;
+} /* }}} int network_config_set_relay_sample */
+
+static int network_config_set_receive_queue_limit(oconfig_item_t *ci) /* {{{ */
+{
+  double tmp = 0.0;
+
+  if (cf_util_get_double(ci, &tmp) != 0)
+    return -1;
+
+  if (tmp < 0.0) {
+    WARNING("network plugin: The `ReceiveQueueLimit' option must not be "
+            "negative.");
+    return -1;
+  }
+
+  network_config_receive_queue_limit = (uint64_t)tmp;
+  return 0;
+} /* }}} int network_config_set_receive_queue_limit */
+
+static int network_config_set_receive_queue_policy(oconfig_item_t *ci) /* {{{ */
+{
+  char *str = NULL;
+
+  if (cf_util_get_string(ci, &str) != 0)
+    return -1;
+
+  int status = 0;
+  if (strcasecmp("DropNewest", str) == 0)
+    network_config_receive_queue_policy = RECEIVE_QUEUE_DROP_NEWEST;
+  else if (strcasecmp("DropOldest", str) == 0)
+    network_config_receive_queue_policy = RECEIVE_QUEUE_DROP_OLDEST;
+  else {
+    WARNING("network plugin: Unknown `ReceiveQueuePolicy': %s.", str);
+    status = -1;
+  }
+
+  sfree(str);
+  return status;
+} /* }}} int network_config_set_receive_queue_policy */
 
 static int network_config_add_server(const oconfig_item_t *ci) /* {{{ */
 {
@@ -2979,6 +5200,10 @@ static int network_config_add_server(const oconfig_item_t *ci) /* {{{ */
       network_config_set_bind_address(child, &se->data.client.bind_addr);
     else if (strcasecmp("ResolveInterval", child->key) == 0)
       cf_util_get_cdtime(child, &se->data.client.resolve_interval);
+    else if (strcasecmp("Compress", child->key) == 0)
+      cf_util_get_boolean(child, &se->data.client.compress);
+    else if (strcasecmp("Protocol", child->key) == 0)
+      network_config_set_protocol(child, &se->socktype);
     else {
       WARNING("network plugin: Option `%s' is not allowed here.", child->key);
     }
@@ -2996,6 +5221,16 @@ static int network_config_add_server(const oconfig_item_t *ci) /* {{{ */
   }
 #endif /* HAVE_GCRYPT_H */
 
+#if !HAVE_ZLIB
+  if (se->data.client.compress) {
+    ERROR("network plugin: The network plugin was built without zlib, so "
+          "the `Compress' option is not supported. Sending uncompressed "
+          "packets to \"%s\".",
+          se->node);
+    se->data.client.compress = false;
+  }
+#endif
+
   status = sockent_init_crypto(se);
   if (status != 0) {
     ERROR("network plugin: network_config_add_server: sockent_init_crypto() "
@@ -3004,8 +5239,14 @@ static int network_config_add_server(const oconfig_item_t *ci) /* {{{ */
     return -1;
   }
 
+  if ((se->socktype == SOCK_STREAM) && (stream_client_create(se) != 0)) {
+    sockent_destroy(se);
+    return -1;
+  }
+
   /* No call to sockent_client_connect() here -- it is called from
-   * network_send_buffer_plain(). */
+   * network_send_buffer_plain(). TCP connections are opened by
+   * stream_client_thread(), which is started in network_init(). */
 
   status = sockent_add(se);
   if (status != 0) {
@@ -3014,6 +5255,11 @@ static int network_config_add_server(const oconfig_item_t *ci) /* {{{ */
     return -1;
   }
 
+  if (se->data.client.compress)
+    sending_sockets_compressed_num++;
+  else
+    sending_sockets_plain_num++;
+
   return 0;
 } /* }}} int network_config_add_server */
 
@@ -3024,6 +5270,8 @@ static int network_config(oconfig_item_t *ci) /* {{{ */
     oconfig_item_t *child = ci->children + i;
     if (strcasecmp("TimeToLive", child->key) == 0)
       network_config_set_ttl(child);
+    else if (strcasecmp("ReceiveThreads", child->key) == 0)
+      network_config_set_receive_threads(child);
   }
 
   for (int i = 0; i < ci->children_num; i++) {
@@ -3033,14 +5281,31 @@ static int network_config(oconfig_item_t *ci) /* {{{ */
       network_config_add_listen(child);
     else if (strcasecmp("Server", child->key) == 0)
       network_config_add_server(child);
-    else if (strcasecmp("TimeToLive", child->key) == 0) {
+    else if ((strcasecmp("TimeToLive", child->key) == 0) ||
+             (strcasecmp("ReceiveThreads", child->key) == 0)) {
       /* Handled earlier */
     } else if (strcasecmp("MaxPacketSize", child->key) == 0)
       network_config_set_buffer_size(child);
     else if (strcasecmp("Forward", child->key) == 0)
       cf_util_get_boolean(child, &network_config_forward);
+    else if (strcasecmp("SendSpread", child->key) == 0)
+      cf_util_get_boolean(child, &network_config_send_spread);
+    else if (strcasecmp("SendRate", child->key) == 0)
+      network_config_set_send_rate(child);
+    else if (strcasecmp("SendBurst", child->key) == 0)
+      network_config_set_send_burst(child);
+    else if (strcasecmp("Relay", child->key) == 0)
+      cf_util_get_boolean(child, &network_config_relay);
+    else if (strcasecmp("RelaySample", child->key) == 0)
+      network_config_set_relay_sample(child);
     else if (strcasecmp("ReportStats", child->key) == 0)
       cf_util_get_boolean(child, &network_config_stats);
+    else if (strcasecmp("ReorderWindow", child->key) == 0)
+      network_config_set_reorder_window(child);
+    else if (strcasecmp("ReceiveQueueLimit", child->key) == 0)
+      network_config_set_receive_queue_limit(child);
+    else if (strcasecmp("ReceiveQueuePolicy", child->key) == 0)
+      network_config_set_receive_queue_policy(child);
     else {
       WARNING("network plugin: Option `%s' is not allowed here.", child->key);
     }
@@ -3112,7 +5377,7 @@ static int network_notification(const notification_t *n,
   if (status != 0)
     return -1;
 
-  network_send_buffer(buffer, sizeof(buffer) - buffer_free);
+  network_send_buffer(buffer, sizeof(buffer) - buffer_free, SEND_TO_ALL);
 
   return 0;
 } /* int network_notification */
@@ -3120,31 +5385,69 @@ static int network_notification(const notification_t *n,
 static int network_shutdown(void) {
   listen_loop++;
 
-  /* Kill the listening thread */
-  if (receive_thread_running != 0) {
-    INFO("network plugin: Stopping receive thread.");
-    pthread_kill(receive_thread_id, SIGTERM);
-    pthread_join(receive_thread_id, NULL /* no return value */);
-    memset(&receive_thread_id, 0, sizeof(receive_thread_id));
-    receive_thread_running = 0;
-  }
+  for (size_t i = 0; i < receivers_num; i++) {
+    receiver_t *r = receivers + i;
+
+    /* Kill the listening thread */
+    if (r->receive_thread_running) {
+      INFO("network plugin: Stopping receive thread.");
+      pthread_kill(r->receive_thread_id, SIGTERM);
+      pthread_join(r->receive_thread_id, NULL /* no return value */);
+      memset(&r->receive_thread_id, 0, sizeof(r->receive_thread_id));
+      r->receive_thread_running = false;
+    }
+
+    if (r->stream_thread_running) {
+      INFO("network plugin: Stopping stream receive thread.");
+      pthread_kill(r->stream_thread_id, SIGTERM);
+      pthread_join(r->stream_thread_id, NULL /* no return value */);
+      r->stream_thread_running = false;
+    }
 
-  /* Shutdown the dispatching thread */
-  if (dispatch_thread_running != 0) {
-    INFO("network plugin: Stopping dispatch thread.");
-    pthread_mutex_lock(&receive_list_lock);
-    pthread_cond_broadcast(&receive_list_cond);
-    pthread_mutex_unlock(&receive_list_lock);
-    pthread_join(dispatch_thread_id, /* ret = */ NULL);
-    dispatch_thread_running = 0;
+    /* Shutdown the dispatching thread */
+    if (r->dispatch_thread_running) {
+      INFO("network plugin: Stopping dispatch thread.");
+      pthread_mutex_lock(&r->list_lock);
+      pthread_cond_broadcast(&r->list_cond);
+      pthread_mutex_unlock(&r->list_lock);
+      pthread_join(r->dispatch_thread_id, /* ret = */ NULL);
+      r->dispatch_thread_running = false;
+    }
   }
 
   sockent_destroy(listen_sockets);
+  receivers_destroy();
+  receive_free_list_destroy();
+  sender_stats_destroy();
+
+  send_buffers_destroy();
+  pthread_key_delete(send_buffer_key);
+
+  /* The pacing thread sends what is queued before it exits. */
+  if (send_pace_thread_running) {
+    pthread_mutex_lock(&send_pace_lock);
+    send_pace_stop = true;
+    pthread_cond_broadcast(&send_pace_cond);
+    pthread_mutex_unlock(&send_pace_lock);
+
+    pthread_join(send_pace_thread_id, /* ret = */ NULL);
+    send_pace_thread_running = false;
+  }
+
+  /* The stream threads write what is queued before they exit. */
+  for (sockent_t *se = sending_sockets; se != NULL; se = se->next) {
+    struct stream_client_s *sc = se->data.client.stream;
+    if ((sc == NULL) || !sc->thread_running)
+      continue;
 
-  if (send_buffer_fill > 0)
-    flush_buffer();
+    pthread_mutex_lock(&se->lock);
+    sc->stop = true;
+    pthread_cond_broadcast(&sc->cond);
+    pthread_mutex_unlock(&se->lock);
 
-  sfree(send_buffer);
+    pthread_join(sc->thread_id, /* ret = */ NULL);
+    sc->thread_running = false;
+  }
 
   for (sockent_t *se = sending_sockets; se != NULL; se = se->next)
     sockent_client_disconnect(se);
@@ -3158,6 +5461,56 @@ static int network_shutdown(void) {
   return 0;
 } /* int network_shutdown */
 
+/* Dispatches the statistics of every sender, using the sender's address as
+ * plugin instance. */
+static void network_stats_read_senders(value_list_t *vl) /* {{{ */
+{
+  size_t num = 0;
+
+  /* Copy the counters, so that the lock isn't held while dispatching. */
+  pthread_mutex_lock(&sender_stats_lock);
+  sender_stats_t *copy = calloc(sender_stats_num + 1, sizeof(*copy));
+  if (copy != NULL) {
+    for (size_t i = 0; i < SENDER_STATS_BUCKETS; i++)
+      for (sender_stats_t *ss = sender_stats[i]; ss != NULL; ss = ss->next)
+        copy[num++] = *ss;
+  }
+  pthread_mutex_unlock(&sender_stats_lock);
+
+  if (copy == NULL) {
+    ERROR("network plugin: calloc failed.");
+    return;
+  }
+
+  for (size_t i = 0; i < num; i++) {
+    sender_stats_t *ss = copy + i;
+
+    if ((ss->family != AF_INET) && (ss->family != AF_INET6))
+      continue;
+    if (inet_ntop(ss->family, ss->addr, vl->plugin_instance,
+                  sizeof(vl->plugin_instance)) == NULL)
+      continue;
+
+    vl->values[0].derive = (derive_t)ss->packets;
+    sstrncpy(vl->type, "if_rx_packets", sizeof(vl->type));
+    vl->type_instance[0] = 0;
+    plugin_dispatch_values(vl);
+
+    vl->values[0].derive = (derive_t)ss->dropped;
+    sstrncpy(vl->type, "if_rx_dropped", sizeof(vl->type));
+    plugin_dispatch_values(vl);
+
+    vl->values[0].derive = (derive_t)ss->values;
+    sstrncpy(vl->type, "total_values", sizeof(vl->type));
+    sstrncpy(vl->type_instance, "received", sizeof(vl->type_instance));
+    plugin_dispatch_values(vl);
+  }
+
+  vl->plugin_instance[0] = 0;
+  vl->type_instance[0] = 0;
+  sfree(copy);
+} /* }}} void network_stats_read_senders */
+
 static int network_stats_read(void) /* {{{ */
 {
   derive_t copy_octets_rx;
@@ -3180,7 +5533,9 @@ static int network_stats_read(void) /* {{{ */
   copy_values_not_dispatched = stats_values_not_dispatched;
   copy_values_sent = stats_values_sent;
   copy_values_not_sent = stats_values_not_sent;
-  copy_receive_list_length = receive_list_length;
+  copy_receive_list_length = 0;
+  for (size_t i = 0; i < receivers_num; i++)
+    copy_receive_list_length += receivers[i].list_length;
 
   /* Initialize `vl' */
   vl.values = values;
@@ -3226,6 +5581,13 @@ static int network_stats_read(void) /* {{{ */
   vl.type_instance[0] = 0;
   plugin_dispatch_values(&vl);
 
+  /* Packets dropped because the receive queue was full */
+  vl.values[0].derive = stats_packets_dropped;
+  sstrncpy(vl.type, "if_rx_dropped", sizeof(vl.type));
+  plugin_dispatch_values(&vl);
+
+  network_stats_read_senders(&vl);
+
   return 0;
 } /* }}} int network_stats_read */
 
@@ -3243,12 +5605,11 @@ static int network_init(void) {
 
   plugin_register_shutdown("network", network_shutdown);
 
-  send_buffer = malloc(network_config_packet_size);
-  if (send_buffer == NULL) {
-    ERROR("network plugin: malloc failed.");
+  int status = pthread_key_create(&send_buffer_key, /* destructor = */ NULL);
+  if (status != 0) {
+    ERROR("network plugin: pthread_key_create failed: %s", STRERROR(status));
     return -1;
   }
-  network_init_buffer();
 
   /* setup socket(s) and so on */
   if (sending_sockets != NULL) {
@@ -3258,31 +5619,92 @@ static int network_init(void) {
                                  /* user_data = */ NULL);
   }
 
-  /* If no threads need to be started, return here. */
-  if ((listen_sockets_num == 0) ||
-      ((dispatch_thread_running != 0) && (receive_thread_running != 0)))
-    return 0;
+  /* Split the memory budget evenly between the receivers. */
+  if ((network_config_receive_queue_limit > 0) && (receivers_num > 0)) {
+    uint64_t entry_size =
+        sizeof(receive_list_entry_t) + network_config_packet_size;
+    receive_queue_max =
+        network_config_receive_queue_limit / (entry_size * receivers_num);
+    if (receive_queue_max < RECEIVE_BATCH_SIZE) {
+      WARNING("network plugin: `ReceiveQueueLimit' is too small. Queueing up "
+              "to %d packets per receive thread.",
+              RECEIVE_BATCH_SIZE);
+      receive_queue_max = RECEIVE_BATCH_SIZE;
+    }
+  }
 
-  if (dispatch_thread_running == 0) {
-    int status;
-    status = plugin_thread_create(&dispatch_thread_id, dispatch_thread,
-                                  NULL /* no argument */, "network disp");
+  if ((sending_sockets != NULL) && !send_pace_thread_running &&
+      (network_config_send_spread || (network_config_send_rate > 0.0))) {
+    send_pace_interval = plugin_get_interval();
+    send_pace_offset = hash_name(hostname_g) % send_pace_interval;
+    if (network_config_send_spread)
+      INFO("network plugin: Sending packets %.3f seconds into each interval.",
+           CDTIME_T_TO_DOUBLE(send_pace_offset));
+
+    status = plugin_thread_create(&send_pace_thread_id, send_pace_thread, NULL,
+                                  "network pace");
     if (status != 0) {
       ERROR("network: pthread_create failed: %s", STRERRNO);
     } else {
-      dispatch_thread_running = 1;
+      send_pace_thread_running = true;
     }
   }
 
-  if (receive_thread_running == 0) {
-    int status;
-    status = plugin_thread_create(&receive_thread_id, receive_thread,
-                                  NULL /* no argument */, "network recv");
+  for (sockent_t *se = sending_sockets; se != NULL; se = se->next) {
+    struct stream_client_s *sc = se->data.client.stream;
+    if ((sc == NULL) || sc->thread_running)
+      continue;
+
+    status = plugin_thread_create(&sc->thread_id, stream_client_thread, se,
+                                  "network send");
     if (status != 0) {
       ERROR("network: pthread_create failed: %s", STRERRNO);
     } else {
-      receive_thread_running = 1;
+      sc->thread_running = true;
+    }
+  }
+
+  for (size_t i = 0; i < receivers_num; i++) {
+    receiver_t *r = receivers + i;
+
+    /* Receivers without sockets don't need any threads. */
+    if ((r->pollfd_num == 0) && (r->stream_listen_num == 0))
+      continue;
+
+    if (!r->dispatch_thread_running) {
+      int status;
+      status = plugin_thread_create(&r->dispatch_thread_id, dispatch_thread, r,
+                                    "network disp");
+      if (status != 0) {
+        ERROR("network: pthread_create failed: %s", STRERRNO);
+      } else {
+        r->dispatch_thread_running = true;
+      }
+    }
+
+    if ((r->pollfd_num > 0) && !r->receive_thread_running) {
+      int status;
+      status = plugin_thread_create(&r->receive_thread_id, receive_thread, r,
+                                    "network recv");
+      if (status != 0) {
+        ERROR("network: pthread_create failed: %s", STRERRNO);
+      } else {
+        r->receive_thread_running = true;
+      }
     }
+
+#if HAVE_SYS_EPOLL_H
+    if ((r->stream_listen_num > 0) && !r->stream_thread_running) {
+      int status;
+      status = plugin_thread_create(&r->stream_thread_id, stream_thread, r,
+                                    "network tcp");
+      if (status != 0) {
+        ERROR("network: pthread_create failed: %s", STRERRNO);
+      } else {
+        r->stream_thread_running = true;
+      }
+    }
+#endif
   }
 
   return 0;
@@ -3298,19 +5720,17 @@ static int network_init(void) {
 static int network_flush(cdtime_t timeout,
                          __attribute__((unused)) const char *identifier,
                          __attribute__((unused)) user_data_t *user_data) {
-  pthread_mutex_lock(&send_buffer_lock);
-
-  if (send_buffer_fill > 0) {
-    if (timeout > 0) {
-      cdtime_t now = cdtime();
-      if ((send_buffer_last_update + timeout) > now) {
-        pthread_mutex_unlock(&send_buffer_lock);
-        return 0;
-      }
-    }
-    flush_buffer();
+  cdtime_t now = cdtime();
+
+  pthread_mutex_lock(&send_buffers_lock);
+  for (send_buffer_t *sb = send_buffers; sb != NULL; sb = sb->next) {
+    pthread_mutex_lock(&sb->lock);
+    if (!send_buffer_is_empty(sb) &&
+        ((timeout == 0) || ((sb->last_update + timeout) <= now)))
+      send_buffer_flush(sb);
+    pthread_mutex_unlock(&sb->lock);
   }
-  pthread_mutex_unlock(&send_buffer_lock);
+  pthread_mutex_unlock(&send_buffers_lock);
 
   return 0;
 } /* int network_flush */
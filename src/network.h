@@ -77,4 +77,7 @@
 #define TYPE_SIGN_SHA256 0x0200
 #define TYPE_ENCR_AES256 0x0210
 
+/* Deflate (zlib) compressed run of the parts above */
+#define TYPE_COMPR_ZLIB 0x0220
+
 #endif /* NETWORK_H */
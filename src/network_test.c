@@ -239,8 +239,347 @@ DEF_TEST(parse_packet) {
   return 0;
 }
 
+DEF_TEST(parse_part_values) {
+  data_source_t dsrc[] = {
+      {.name = "gauge", .type = DS_TYPE_GAUGE},
+      {.name = "derive", .type = DS_TYPE_DERIVE},
+  };
+  data_set_t ds = {.type = "test", .ds_num = 2, .ds = dsrc};
+  value_t in[] = {{.gauge = 42.5}, {.derive = -23}};
+  value_list_t vl = {.values = in, .values_len = 2};
+
+  char buffer[64];
+  char *write_ptr = buffer;
+  size_t write_free = sizeof(buffer);
+  EXPECT_EQ_INT(0, write_part_values(&write_ptr, &write_free, &ds, &vl));
+  size_t part_size = sizeof(buffer) - write_free;
+
+  value_t *values = NULL;
+  size_t values_size = 0;
+
+  /* The second call reuses the buffer allocated by the first one. */
+  for (int i = 0; i < 2; i++) {
+    void *read_ptr = buffer;
+    size_t read_size = part_size;
+    size_t values_num = 0;
+
+    EXPECT_EQ_INT(0, parse_part_values(&read_ptr, &read_size, &values,
+                                       &values_size, &values_num));
+    EXPECT_EQ_INT(2, (int)values_num);
+    EXPECT_EQ_INT(2, (int)values_size);
+    EXPECT_EQ_INT(0, (int)read_size);
+    EXPECT_EQ_DOUBLE(42.5, values[0].gauge);
+    EXPECT_EQ_INT(-23, (int)values[1].derive);
+  }
+
+  sfree(values);
+  return 0;
+}
+
+#if HAVE_GCRYPT_H
+DEF_TEST(server_user_cache) {
+  char auth_file[] = "/tmp/collectd-network-test.XXXXXX";
+  int fd = mkstemp(auth_file);
+  OK(fd >= 0);
+  char const content[] = "alice: secret\n";
+  EXPECT_EQ_INT((int)strlen(content),
+                (int)write(fd, content, strlen(content)));
+  close(fd);
+
+  EXPECT_EQ_INT(0, network_init_gcrypt());
+
+  sockent_t *se = sockent_create(SOCKENT_TYPE_SERVER);
+  CHECK_NOT_NULL(se);
+  se->data.server.userdb = fbh_create(auth_file);
+  CHECK_NOT_NULL(se->data.server.userdb);
+
+  /* The handles are created once and reused for every packet. */
+  struct server_user *u = sockent_server_user(se, "alice");
+  CHECK_NOT_NULL(u);
+  EXPECT_EQ_PTR(u, sockent_server_user(se, "alice"));
+  EXPECT_EQ_PTR(NULL, sockent_server_user(se, "bob"));
+
+  sockent_destroy(se);
+  unlink(auth_file);
+  return 0;
+}
+#endif
+
+#if HAVE_ZLIB
+DEF_TEST(compressed_packet) {
+  data_source_t dsrc[] = {{.name = "value", .type = DS_TYPE_GAUGE}};
+  data_set_t ds = {.type = "gauge", .ds_num = 1, .ds = dsrc};
+  value_t values[] = {{.gauge = 42.0}};
+  value_list_t vl = {
+      .values = values,
+      .values_len = 1,
+      .time = TIME_T_TO_CDTIME_T(1594809888),
+      .interval = TIME_T_TO_CDTIME_T(10),
+      .host = "example.com",
+      .plugin = "test",
+      .type = "gauge",
+  };
+
+  send_zbuffer_t *zb = send_zbuffer_create();
+  CHECK_NOT_NULL(zb);
+
+  /* Far more value lists than fit into a plain packet. */
+  for (int i = 0; i < 100; i++) {
+    snprintf(vl.type_instance, sizeof(vl.type_instance), "instance%d", i);
+    EXPECT_EQ_INT(0, send_zbuffer_add(zb, &ds, &vl));
+  }
+  OK(zb->stream.total_in + zb->pending_fill > network_config_packet_size);
+  /* Nothing was sent yet. */
+  EXPECT_EQ_INT(0, (int)stats_packets_tx);
+
+  EXPECT_EQ_INT(0, send_zbuffer_deflate(zb, Z_FINISH));
+  size_t packet_size = sizeof(part_header_t) + zb->stream.total_out;
+  OK(packet_size <= network_config_packet_size - BUFF_SIG_SIZE);
+
+  uint16_t pkg_type = htons(TYPE_COMPR_ZLIB);
+  uint16_t pkg_length = htons((uint16_t)packet_size);
+  memcpy(zb->packet, &pkg_type, sizeof(pkg_type));
+  memcpy(zb->packet + sizeof(pkg_type), &pkg_length, sizeof(pkg_length));
+
+  sockent_t *se = sockent_create(SOCKENT_TYPE_SERVER);
+  CHECK_NOT_NULL(se);
+
+  derive_t dispatched = stats_values_dispatched;
+  EXPECT_EQ_INT(0, parse_packet(se, zb->packet, packet_size, 0, NULL, NULL));
+  EXPECT_EQ_INT(100, (int)(stats_values_dispatched - dispatched));
+
+  /* Compressed parts within compressed parts are rejected. */
+  uint8_t nested[network_config_packet_size];
+  uLongf nested_size = sizeof(nested) - sizeof(part_header_t);
+  EXPECT_EQ_INT(Z_OK, compress(nested + sizeof(part_header_t), &nested_size,
+                               (Bytef *)zb->packet, packet_size));
+  pkg_length = htons((uint16_t)(sizeof(part_header_t) + nested_size));
+  memcpy(nested, &pkg_type, sizeof(pkg_type));
+  memcpy(nested + sizeof(pkg_type), &pkg_length, sizeof(pkg_length));
+
+  dispatched = stats_values_dispatched;
+  parse_packet(se, nested, sizeof(part_header_t) + nested_size, 0, NULL,
+               NULL);
+  EXPECT_EQ_INT(0, (int)(stats_values_dispatched - dispatched));
+
+  sockent_destroy(se);
+  send_zbuffer_destroy(zb);
+  return 0;
+}
+#endif
+
+/* Adds 64 value lists from four interleaved plugins, which were read at
+ * different times, and returns the number of bytes sent. */
+static derive_t send_interleaved(send_buffer_t *sb, bool reorder) {
+  data_source_t dsrc[] = {{.name = "value", .type = DS_TYPE_GAUGE}};
+  data_set_t ds = {.type = "gauge", .ds_num = 1, .ds = dsrc};
+  value_t values[] = {{.gauge = 42.0}};
+  value_list_t vl = {
+      .values = values,
+      .values_len = 1,
+      .time = TIME_T_TO_CDTIME_T(1594809888),
+      .interval = TIME_T_TO_CDTIME_T(10),
+      .host = "host.example.com",
+      .type = "gauge",
+  };
+
+  derive_t octets = stats_octets_tx;
+  for (int i = 0; i < 64; i++) {
+    snprintf(vl.plugin, sizeof(vl.plugin), "plugin%d", i % 4);
+    vl.time = TIME_T_TO_CDTIME_T(1594809888) + MS_TO_CDTIME_T(i % 4);
+    snprintf(vl.type_instance, sizeof(vl.type_instance), "instance%d", i / 4);
+    if (reorder)
+      EXPECT_EQ_INT(0, send_window_add(sb, &ds, &vl));
+    else
+      EXPECT_EQ_INT(0, send_buffer_add_all(sb, &ds, &vl));
+  }
+  send_buffer_flush(sb);
+
+  return stats_octets_tx - octets;
+}
+
+DEF_TEST(reorder_window) {
+  send_buffer_t sb = {0};
+  network_config_reorder_window = 16;
+  sending_sockets_plain_num = 1;
+
+  CHECK_NOT_NULL(sb.buffer = malloc(network_config_packet_size));
+  CHECK_NOT_NULL(sb.window = calloc(16, sizeof(*sb.window)));
+  CHECK_NOT_NULL(sb.window_sorted = calloc(16, sizeof(*sb.window_sorted)));
+  send_buffer_reset(&sb);
+
+  derive_t plain = send_interleaved(&sb, false);
+  derive_t reordered = send_interleaved(&sb, true);
+  EXPECT_EQ_INT(0, (int)sb.window_num);
+  /* Each window has four runs of the same plugin and time instead of
+   * sixteen. */
+  OK(reordered < plain);
+
+  for (size_t i = 0; i < 16; i++)
+    sfree(sb.window[i].values);
+  sfree(sb.window);
+  sfree(sb.window_sorted);
+  sfree(sb.buffer);
+  sending_sockets_plain_num = 0;
+  network_config_reorder_window = 0;
+  return 0;
+}
+
+/* Builds a list of `num' packets from 192.0.2.1, numbered ascending. */
+static receive_list_entry_t *make_packets(int first, int num, /* {{{ */
+                                          receive_list_entry_t **ret_tail) {
+  receive_list_entry_t *ents[num];
+  if (receive_entries_get(ents, (size_t)num) != (size_t)num)
+    return NULL;
+
+  for (int i = 0; i < num; i++) {
+    struct sockaddr_in *sin = (struct sockaddr_in *)&ents[i]->sender;
+    memset(&ents[i]->sender, 0, sizeof(ents[i]->sender));
+    sin->sin_family = AF_INET;
+    sin->sin_addr.s_addr = htonl(0xC0000201);
+    ents[i]->data_len = first + i;
+    ents[i]->next = (i + 1 < num) ? ents[i + 1] : NULL;
+  }
+
+  *ret_tail = ents[num - 1];
+  return ents[0];
+} /* }}} receive_list_entry_t *make_packets */
+
+static int queued_packets(receiver_t *r, char *buffer, size_t buffer_size) {
+  buffer[0] = 0;
+  for (receive_list_entry_t *ent = r->list_head; ent != NULL; ent = ent->next)
+    snprintf(buffer + strlen(buffer), buffer_size - strlen(buffer), "%s%d",
+             (ent == r->list_head) ? "" : ",", ent->data_len);
+  return (int)r->list_length;
+}
+
+DEF_TEST(receive_queue_limit) {
+  receiver_t r = {0};
+  pthread_mutex_init(&r.list_lock, NULL);
+  pthread_cond_init(&r.list_cond, NULL);
+
+  network_config_stats = true;
+  receive_queue_max = 4;
+  derive_t dropped = stats_packets_dropped;
+
+  receive_list_entry_t *head;
+  receive_list_entry_t *tail;
+  char got[64];
+
+  network_config_receive_queue_policy = RECEIVE_QUEUE_DROP_NEWEST;
+  CHECK_NOT_NULL(head = make_packets(1, 3, &tail));
+  receiver_enqueue(&r, head, tail, 3);
+  CHECK_NOT_NULL(head = make_packets(4, 3, &tail));
+  receiver_enqueue(&r, head, tail, 3);
+  EXPECT_EQ_INT(4, queued_packets(&r, got, sizeof(got)));
+  EXPECT_EQ_STR("1,2,3,4", got);
+  EXPECT_EQ_INT(4, r.list_tail->data_len);
+  EXPECT_EQ_INT(2, (int)(stats_packets_dropped - dropped));
+
+  network_config_receive_queue_policy = RECEIVE_QUEUE_DROP_OLDEST;
+  CHECK_NOT_NULL(head = make_packets(7, 3, &tail));
+  receiver_enqueue(&r, head, tail, 3);
+  EXPECT_EQ_INT(4, queued_packets(&r, got, sizeof(got)));
+  EXPECT_EQ_STR("4,7,8,9", got);
+
+  /* More new packets than fit drop the whole queue. */
+  CHECK_NOT_NULL(head = make_packets(10, 6, &tail));
+  receiver_enqueue(&r, head, tail, 6);
+  EXPECT_EQ_INT(4, queued_packets(&r, got, sizeof(got)));
+  EXPECT_EQ_STR("12,13,14,15", got);
+  EXPECT_EQ_INT(11, (int)(stats_packets_dropped - dropped));
+
+  struct sockaddr_storage sender = {0};
+  memcpy(&sender, &r.list_head->sender, sizeof(sender));
+  sender_stats_t *ss = sender_stats_get(&sender);
+  CHECK_NOT_NULL(ss);
+  EXPECT_EQ_INT(11, (int)ss->dropped);
+
+  receive_entries_put(r.list_head);
+  receive_free_list_destroy();
+  sender_stats_destroy();
+  pthread_cond_destroy(&r.list_cond);
+  pthread_mutex_destroy(&r.list_lock);
+  receive_queue_max = 0;
+  network_config_stats = false;
+  return 0;
+}
+
+#if HAVE_SYS_EPOLL_H
+DEF_TEST(stream_frames) {
+  int fds[2];
+  EXPECT_EQ_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+
+  receiver_t r = {0};
+  stream_conn_t *c = stream_conn_create(&r, fds[0], /* listen_fd = */ -1);
+  CHECK_NOT_NULL(c);
+
+  char frames[3 * STREAM_FRAME_HEADER_SIZE + 10 + 100 + 1000];
+  size_t frames_size = 0;
+  size_t sizes[] = {10, 100, 1000};
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(sizes); i++) {
+    uint32_t tmp = htonl((uint32_t)sizes[i]);
+    memcpy(frames + frames_size, &tmp, sizeof(tmp));
+    memset(frames + frames_size + sizeof(tmp), 'a' + (int)i, sizes[i]);
+    frames_size += sizeof(tmp) + sizes[i];
+  }
+
+  char buffer[STREAM_READ_SIZE];
+  receive_list_entry_t *head = NULL;
+  receive_list_entry_t *tail = NULL;
+  uint64_t length = 0;
+
+  /* Split within the second frame's header and within the third frame. */
+  size_t splits[] = {16, 300, frames_size};
+  size_t offset = 0;
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(splits); i++) {
+    size_t size = splits[i] - offset;
+    EXPECT_EQ_INT((int)size, (int)write(fds[1], frames + offset, size));
+    EXPECT_EQ_INT(0, stream_conn_read(c, buffer, &head, &tail, &length));
+    offset = splits[i];
+  }
+
+  EXPECT_EQ_INT(3, (int)length);
+  receive_list_entry_t *ent = head;
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(sizes); i++) {
+    CHECK_NOT_NULL(ent);
+    EXPECT_EQ_INT((int)sizes[i], ent->data_len);
+    EXPECT_EQ_INT('a' + (int)i, ent->data[sizes[i] - 1]);
+    ent = ent->next;
+  }
+  EXPECT_EQ_INT(0, (int)c->fill);
+  receive_entries_put(head);
+
+  /* Frames larger than a packet close the connection. */
+  uint32_t tmp = htonl((uint32_t)network_config_packet_size + 1);
+  EXPECT_EQ_INT((int)sizeof(tmp), (int)write(fds[1], &tmp, sizeof(tmp)));
+  OK(stream_conn_read(c, buffer, &head, &tail, &length) != 0);
+
+  /* So does the end of the stream. */
+  close(fds[1]);
+  OK(stream_conn_read(c, buffer, &head, &tail, &length) != 0);
+
+  stream_conn_destroy(&r, c);
+  EXPECT_EQ_PTR(NULL, r.stream_conns);
+  receive_free_list_destroy();
+  return 0;
+}
+#endif
+
 int main() {
   RUN_TEST(parse_packet);
+  RUN_TEST(parse_part_values);
+#if HAVE_GCRYPT_H
+  RUN_TEST(server_user_cache);
+#endif
+#if HAVE_ZLIB
+  RUN_TEST(compressed_packet);
+#endif
+  RUN_TEST(receive_queue_limit);
+  RUN_TEST(reorder_window);
+#if HAVE_SYS_EPOLL_H
+  RUN_TEST(stream_frames);
+#endif
 
   END_TEST;
 }
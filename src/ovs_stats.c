@@ -28,6 +28,7 @@
  *   Taras Chornyi <tarasx.chornyi@intel.com>
  */
 
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 
 #include "utils/ovs/ovs.h" /* OvS helpers */
@@ -100,6 +101,7 @@ typedef struct interface_s {
   char ex_iface_id[UUID_SIZE];        /* External iface id */
   char ex_vm_id[UUID_SIZE];           /* External vm id */
   int64_t stats[IFACE_COUNTER_COUNT]; /* Statistics for interface */
+  struct port_s *port;                /* Port the interface belongs to */
   struct interface_s *next;           /* Next interface for associated port */
 } interface_list_t;
 
@@ -181,6 +183,10 @@ static bridge_list_t *g_monitored_bridge_list_head;
 /* entry into the list of network bridges */
 static port_list_t *g_port_list_head;
 
+/* Ports and interfaces indexed by their table uuid */
+static c_avl_tree_t *g_port_tree;
+static c_avl_tree_t *g_iface_tree;
+
 /* lock for statistics cache */
 static pthread_mutex_t g_stats_lock;
 
@@ -525,55 +531,52 @@ static void ovs_stats_submit_port(port_list_t *port) {
 }
 
 static port_list_t *ovs_stats_get_port(const char *uuid) {
-  if (uuid == NULL)
-    return NULL;
+  port_list_t *port = NULL;
 
-  for (port_list_t *port = g_port_list_head; port != NULL; port = port->next) {
-    if (strncmp(port->port_uuid, uuid, strlen(port->port_uuid)) == 0)
-      return port;
-  }
-  return NULL;
+  if (uuid == NULL || c_avl_get(g_port_tree, uuid, (void *)&port) != 0)
+    return NULL;
+  return port;
 }
 
-static port_list_t *ovs_stats_get_port_by_interface_uuid(const char *uuid) {
-  if (uuid == NULL)
+static interface_list_t *ovs_stats_get_interface(const char *uuid) {
+  interface_list_t *iface = NULL;
+
+  if (uuid == NULL || c_avl_get(g_iface_tree, uuid, (void *)&iface) != 0)
     return NULL;
+  return iface;
+}
 
-  for (port_list_t *port = g_port_list_head; port != NULL; port = port->next) {
-    for (interface_list_t *iface = port->iface; iface != NULL;
-         iface = iface->next) {
-      if (strncmp(iface->iface_uuid, uuid, strlen(uuid)) == 0)
-        return port;
+/* Remove interface from the interface list of its port */
+static void ovs_stats_unlink_interface(interface_list_t *iface) {
+  port_list_t *port = iface->port;
+
+  for (interface_list_t **i = (port != NULL) ? &port->iface : NULL;
+       i != NULL && *i != NULL; i = &(*i)->next) {
+    if (*i == iface) {
+      *i = iface->next;
+      break;
     }
   }
-  return NULL;
+  iface->port = NULL;
+  iface->next = NULL;
 }
 
-static interface_list_t *ovs_stats_get_port_interface(port_list_t *port,
-                                                      const char *uuid) {
-  if (port == NULL || uuid == NULL)
+/* Create interface that does not belong to any port yet. Interface rows may
+ * arrive before the Port row that refers to them. */
+static interface_list_t *ovs_stats_new_interface(const char *uuid) {
+  interface_list_t *iface = calloc(1, sizeof(*iface));
+  if (iface == NULL) {
+    ERROR("%s: Error allocating interface", plugin_name);
     return NULL;
-
-  for (interface_list_t *iface = port->iface; iface != NULL;
-       iface = iface->next) {
-    if (strncmp(iface->iface_uuid, uuid, strlen(uuid)) == 0)
-      return iface;
   }
-  return NULL;
-}
-
-static interface_list_t *ovs_stats_get_interface(const char *uuid) {
-  if (uuid == NULL)
+  memset(iface->stats, -1, sizeof(int64_t[IFACE_COUNTER_COUNT]));
+  sstrncpy(iface->iface_uuid, uuid, sizeof(iface->iface_uuid));
+  if (c_avl_insert(g_iface_tree, iface->iface_uuid, iface) != 0) {
+    ERROR("%s: Error indexing interface", plugin_name);
+    sfree(iface);
     return NULL;
-
-  for (port_list_t *port = g_port_list_head; port != NULL; port = port->next) {
-    for (interface_list_t *iface = port->iface; iface != NULL;
-         iface = iface->next) {
-      if (strncmp(iface->iface_uuid, uuid, strlen(uuid)) == 0)
-        return iface;
-    }
   }
-  return NULL;
+  return iface;
 }
 
 static interface_list_t *ovs_stats_new_port_interface(port_list_t *port,
@@ -581,20 +584,20 @@ static interface_list_t *ovs_stats_new_port_interface(port_list_t *port,
   if (uuid == NULL)
     return NULL;
 
-  interface_list_t *iface = ovs_stats_get_port_interface(port, uuid);
+  interface_list_t *iface = ovs_stats_get_interface(uuid);
+  if (iface != NULL && iface->port == port)
+    return iface;
 
-  if (iface == NULL) {
-    iface = calloc(1, sizeof(*iface));
-    if (iface == NULL) {
-      ERROR("%s: Error allocating interface", plugin_name);
-      return NULL;
-    }
-    memset(iface->stats, -1, sizeof(int64_t[IFACE_COUNTER_COUNT]));
-    sstrncpy(iface->iface_uuid, uuid, sizeof(iface->iface_uuid));
-    interface_list_t *iface_head = port->iface;
-    iface->next = iface_head;
-    port->iface = iface;
+  if (iface != NULL) {
+    /* interface has been moved to another port */
+    ovs_stats_unlink_interface(iface);
+  } else if ((iface = ovs_stats_new_interface(uuid)) == NULL) {
+    return NULL;
   }
+
+  iface->port = port;
+  iface->next = port->iface;
+  port->iface = iface;
   return iface;
 }
 
@@ -613,6 +616,11 @@ static port_list_t *ovs_stats_new_port(bridge_list_t *bridge,
       return NULL;
     }
     sstrncpy(port->port_uuid, uuid, sizeof(port->port_uuid));
+    if (c_avl_insert(g_port_tree, port->port_uuid, port) != 0) {
+      ERROR("%s: Error indexing port", plugin_name);
+      sfree(port);
+      return NULL;
+    }
     port->next = g_port_list_head;
     g_port_list_head = port;
   }
@@ -886,26 +894,31 @@ static int ovs_stats_update_port(const char *uuid, yajl_val port) {
 
 /* Delete port from global port list */
 static int ovs_stats_del_port(const char *uuid) {
-  port_list_t *prev_port = g_port_list_head;
-  for (port_list_t *port = g_port_list_head; port != NULL;
-       prev_port = port, port = port->next) {
-    if (strncmp(port->port_uuid, uuid, strlen(port->port_uuid)) == 0) {
-      if (port == g_port_list_head)
-        g_port_list_head = port->next;
-      else
-        prev_port->next = port->next;
+  port_list_t *port = ovs_stats_get_port(uuid);
+  if (port == NULL)
+    return 0;
 
-      for (interface_list_t *iface = port->iface; iface != NULL;
-           iface = port->iface) {
-        interface_list_t *del = iface;
-        port->iface = iface->next;
-        sfree(del);
+  c_avl_remove(g_port_tree, port->port_uuid, NULL, NULL);
+  if (port == g_port_list_head) {
+    g_port_list_head = port->next;
+  } else {
+    for (port_list_t *prev = g_port_list_head; prev != NULL;
+         prev = prev->next) {
+      if (prev->next == port) {
+        prev->next = port->next;
+        break;
       }
-
-      sfree(port);
-      break;
     }
   }
+
+  while (port->iface != NULL) {
+    interface_list_t *del = port->iface;
+    port->iface = del->next;
+    c_avl_remove(g_iface_tree, del->iface_uuid, NULL, NULL);
+    sfree(del);
+  }
+
+  sfree(port);
   return 0;
 }
 
@@ -964,9 +977,10 @@ static void ovs_stats_port_table_delete_cb(yajl_val jupdates) {
   return;
 }
 
-/* Update interface statistics */
+/* Update interface statistics. With `is_diff', `stats' only holds the
+ * changed counters and a counter that still has its old value was removed. */
 static int ovs_stats_update_iface_stats(interface_list_t *iface,
-                                        yajl_val stats) {
+                                        yajl_val stats, bool is_diff) {
 
   if (!stats || !YAJL_IS_ARRAY(stats))
     return 0;
@@ -982,15 +996,19 @@ static int ovs_stats_update_iface_stats(interface_list_t *iface,
     if (counter_index == not_supported)
       continue;
 
-    iface->stats[counter_index] = counter_value;
+    if (is_diff && iface->stats[counter_index] == counter_value)
+      iface->stats[counter_index] = -1;
+    else
+      iface->stats[counter_index] = counter_value;
   }
 
   return 0;
 }
 
-/* Update interface external_ids */
+/* Update interface external_ids. With `is_diff', `ext_ids' only holds the
+ * changed pairs and a pair that still has its old value was removed. */
 static int ovs_stats_update_iface_ext_ids(interface_list_t *iface,
-                                          yajl_val ext_ids) {
+                                          yajl_val ext_ids, bool is_diff) {
 
   if (!ext_ids || !YAJL_IS_ARRAY(ext_ids))
     return 0;
@@ -1003,11 +1021,22 @@ static int ovs_stats_update_iface_ext_ids(interface_list_t *iface,
     char *key = YAJL_GET_STRING(YAJL_GET_ARRAY(ext_id)->values[0]);
     char *value = YAJL_GET_STRING(YAJL_GET_ARRAY(ext_id)->values[1]);
     if (key && value) {
+      char *id = NULL;
+      size_t id_size = 0;
       if (strncmp(key, "iface-id", strlen(key)) == 0) {
-        sstrncpy(iface->ex_iface_id, value, sizeof(iface->ex_iface_id));
+        id = iface->ex_iface_id;
+        id_size = sizeof(iface->ex_iface_id);
       } else if (strncmp(key, "vm-uuid", strlen(key)) == 0) {
-        sstrncpy(iface->ex_vm_id, value, sizeof(iface->ex_vm_id));
+        id = iface->ex_vm_id;
+        id_size = sizeof(iface->ex_vm_id);
       }
+      if (id == NULL)
+        continue;
+
+      if (is_diff && strcmp(id, value) == 0)
+        id[0] = 0;
+      else
+        sstrncpy(id, value, id_size);
     }
   }
 
@@ -1015,36 +1044,34 @@ static int ovs_stats_update_iface_ext_ids(interface_list_t *iface,
 }
 
 /* Get interface statistic and external_ids */
-static int ovs_stats_update_iface(yajl_val iface_obj) {
+static int ovs_stats_update_iface(const char *uuid, yajl_val iface_obj) {
   if (!iface_obj || !YAJL_IS_OBJECT(iface_obj)) {
     ERROR("ovs_stats plugin: incorrect JSON interface data");
     return -1;
   }
 
+  /* <table-updates> carry the whole row in "new". <table-updates2> carry it
+   * in "initial" or "insert", while "modify" only holds what changed. */
+  bool is_diff = false;
   yajl_val row = ovs_utils_get_value_by_key(iface_obj, "new");
+  if (row == NULL)
+    row = ovs_utils_get_value_by_key(iface_obj, "initial");
+  if (row == NULL)
+    row = ovs_utils_get_value_by_key(iface_obj, "insert");
+  if (row == NULL) {
+    row = ovs_utils_get_value_by_key(iface_obj, "modify");
+    is_diff = true;
+  }
   if (!row || !YAJL_IS_OBJECT(row))
     return 0;
 
-  yajl_val iface_name = ovs_utils_get_value_by_key(row, "name");
-  if (!iface_name || !YAJL_IS_STRING(iface_name))
-    return 0;
-
-  yajl_val iface_uuid = ovs_utils_get_value_by_key(row, "_uuid");
-  if (!iface_uuid || !YAJL_IS_ARRAY(iface_uuid) ||
-      YAJL_GET_ARRAY(iface_uuid)->len != 2)
-    return 0;
-
-  char *iface_uuid_str = YAJL_GET_STRING(YAJL_GET_ARRAY(iface_uuid)->values[1]);
-  if (iface_uuid_str == NULL) {
-    ERROR("ovs_stats plugin: incorrect JSON interface data");
+  interface_list_t *iface = ovs_stats_get_interface(uuid);
+  if (iface == NULL && (iface = ovs_stats_new_interface(uuid)) == NULL)
     return -1;
-  }
 
-  interface_list_t *iface = ovs_stats_get_interface(iface_uuid_str);
-  if (iface == NULL)
-    return 0;
-
-  sstrncpy(iface->name, YAJL_GET_STRING(iface_name), sizeof(iface->name));
+  yajl_val iface_name = ovs_utils_get_value_by_key(row, "name");
+  if (iface_name && YAJL_IS_STRING(iface_name))
+    sstrncpy(iface->name, YAJL_GET_STRING(iface_name), sizeof(iface->name));
 
   yajl_val iface_stats = ovs_utils_get_value_by_key(row, "statistics");
   yajl_val iface_ext_ids = ovs_utils_get_value_by_key(row, "external_ids");
@@ -1071,41 +1098,27 @@ static int ovs_stats_update_iface(yajl_val iface_obj) {
 
   if (iface_stats && YAJL_IS_ARRAY(iface_stats) &&
       YAJL_GET_ARRAY(iface_stats)->len == 2)
-    ovs_stats_update_iface_stats(iface, YAJL_GET_ARRAY(iface_stats)->values[1]);
+    ovs_stats_update_iface_stats(iface, YAJL_GET_ARRAY(iface_stats)->values[1],
+                                 is_diff);
 
-  if (iface_ext_ids && YAJL_IS_ARRAY(iface_ext_ids))
-    ovs_stats_update_iface_ext_ids(iface,
-                                   YAJL_GET_ARRAY(iface_ext_ids)->values[1]);
+  if (iface_ext_ids && YAJL_IS_ARRAY(iface_ext_ids) &&
+      YAJL_GET_ARRAY(iface_ext_ids)->len == 2)
+    ovs_stats_update_iface_ext_ids(
+        iface, YAJL_GET_ARRAY(iface_ext_ids)->values[1], is_diff);
 
   return 0;
 }
 
 /* Delete interface */
 static int ovs_stats_del_interface(const char *uuid) {
-  port_list_t *port = ovs_stats_get_port_by_interface_uuid(uuid);
+  interface_list_t *iface = ovs_stats_get_interface(uuid);
 
-  if (port == NULL)
+  if (iface == NULL)
     return 0;
 
-  interface_list_t *prev_iface = NULL;
-
-  for (interface_list_t *iface = port->iface; iface != NULL;
-       iface = port->iface) {
-    if (strncmp(iface->iface_uuid, uuid, strlen(iface->iface_uuid))) {
-
-      interface_list_t *del = iface;
-
-      if (prev_iface == NULL)
-        port->iface = iface->next;
-      else
-        prev_iface->next = iface->next;
-
-      sfree(del);
-      break;
-    } else {
-      prev_iface = iface;
-    }
-  }
+  c_avl_remove(g_iface_tree, iface->iface_uuid, NULL, NULL);
+  ovs_stats_unlink_interface(iface);
+  sfree(iface);
 
   return 0;
 }
@@ -1136,10 +1149,6 @@ static void ovs_stats_interface_table_change_cb(yajl_val jupdates) {
                 ]
               ]
             ],
-            "_uuid": [
-              "uuid",
-              "33a289a0-1d34-4e46-a3c2-3e4066fbecc6"
-            ]
             "external_ids": [
                 "map",
                 [
@@ -1169,7 +1178,8 @@ static void ovs_stats_interface_table_change_cb(yajl_val jupdates) {
 
   pthread_mutex_lock(&g_stats_lock);
   for (size_t i = 0; i < YAJL_GET_OBJECT(interfaces)->len; i++) {
-    ovs_stats_update_iface(YAJL_GET_OBJECT(interfaces)->values[i]);
+    ovs_stats_update_iface(YAJL_GET_OBJECT(interfaces)->keys[i],
+                           YAJL_GET_OBJECT(interfaces)->values[i]);
   }
   pthread_mutex_unlock(&g_stats_lock);
 
@@ -1206,8 +1216,8 @@ static void ovs_stats_interface_table_delete_cb(yajl_val jupdates) {
 static void ovs_stats_initialize(ovs_db_t *pdb) {
   const char *bridge_columns[] = {"name", "ports", NULL};
   const char *port_columns[] = {"name", "interfaces", NULL};
-  const char *interface_columns[] = {"name", "statistics", "_uuid",
-                                     "external_ids", NULL};
+  const char *interface_columns[] = {"name", "statistics", "external_ids",
+                                     NULL};
 
   /* subscribe to a tables */
   ovs_db_table_cb_register(
@@ -1230,28 +1240,34 @@ static void ovs_stats_initialize(ovs_db_t *pdb) {
                            ovs_stats_port_table_delete_cb, NULL,
                            OVS_DB_TABLE_CB_FLAG_DELETE);
 
+  /* Interface statistics change all the time. Let the server send only the
+   * counters that changed, rather than all columns of the modified rows. */
   ovs_db_table_cb_register(
       pdb, "Interface", interface_columns, ovs_stats_interface_table_change_cb,
       ovs_stats_interface_table_result_cb,
       OVS_DB_TABLE_CB_FLAG_INITIAL | OVS_DB_TABLE_CB_FLAG_INSERT |
-          OVS_DB_TABLE_CB_FLAG_MODIFY);
+          OVS_DB_TABLE_CB_FLAG_MODIFY | OVS_DB_TABLE_CB_FLAG_COND_SINCE);
 
   ovs_db_table_cb_register(pdb, "Interface", interface_columns,
                            ovs_stats_interface_table_delete_cb, NULL,
-                           OVS_DB_TABLE_CB_FLAG_DELETE);
+                           OVS_DB_TABLE_CB_FLAG_DELETE |
+                               OVS_DB_TABLE_CB_FLAG_COND_SINCE);
 }
 
 /* Delete all ports from port list */
 static void ovs_stats_free_port_list(port_list_t *head) {
-  for (port_list_t *i = head; i != NULL;) {
-    port_list_t *del = i;
+  void *key;
+  void *value;
 
-    for (interface_list_t *iface = i->iface; iface != NULL; iface = i->iface) {
-      interface_list_t *del2 = iface;
-      i->iface = iface->next;
-      sfree(del2);
-    }
+  /* Every interface is indexed, including those without a port. Keys are
+   * owned by the values. */
+  while (g_iface_tree != NULL && c_avl_pick(g_iface_tree, &key, &value) == 0)
+    sfree(value);
+  while (g_port_tree != NULL && c_avl_pick(g_port_tree, &key, &value) == 0)
+    ;
 
+  for (port_list_t *i = head; i != NULL;) {
+    port_list_t *del = i;
     i = i->next;
     sfree(del);
   }
@@ -1360,6 +1376,13 @@ static int ovs_stats_plugin_init(void) {
   ovs_db_callback_t cb = {.post_conn_init = ovs_stats_initialize,
                           .post_conn_terminate = ovs_stats_conn_terminate};
 
+  g_port_tree = c_avl_create((int (*)(const void *, const void *))strcmp);
+  g_iface_tree = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (g_port_tree == NULL || g_iface_tree == NULL) {
+    ERROR("%s: plugin: failed to create uuid index", plugin_name);
+    return -1;
+  }
+
   INFO("%s: Connecting to OVS DB using address=%s, service=%s, unix=%s",
        plugin_name, ovs_stats_cfg.ovs_db_node, ovs_stats_cfg.ovs_db_serv,
        ovs_stats_cfg.ovs_db_unix);
@@ -1410,6 +1433,10 @@ static int ovs_stats_plugin_shutdown(void) {
   ovs_stats_free_bridge_list(g_bridge_list_head);
   ovs_stats_free_bridge_list(g_monitored_bridge_list_head);
   ovs_stats_free_port_list(g_port_list_head);
+  c_avl_destroy(g_port_tree);
+  c_avl_destroy(g_iface_tree);
+  g_port_tree = NULL;
+  g_iface_tree = NULL;
   pthread_mutex_unlock(&g_stats_lock);
   pthread_mutex_destroy(&g_stats_lock);
   return 0;
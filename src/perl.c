@@ -51,6 +51,7 @@
 #include "utils/common/common.h"
 
 #include "filter_chain.h"
+#include "utils_complain.h"
 
 #if !defined(USE_ITHREADS)
 #error "Perl does not support ithreads!"
@@ -108,6 +109,7 @@ static XS(Collectd_plugin_unregister_ds);
 static XS(Collectd_plugin_dispatch_values);
 static XS(Collectd_plugin_get_interval);
 static XS(Collectd__plugin_write);
+static XS(Collectd__plugin_register_write_batch);
 static XS(Collectd__plugin_flush);
 static XS(Collectd_plugin_dispatch_notification);
 static XS(Collectd_plugin_log);
@@ -117,6 +119,10 @@ static XS(Collectd_call_by_name);
 static int perl_read(user_data_t *ud);
 static int perl_write(const data_set_t *ds, const value_list_t *vl,
                       user_data_t *user_data);
+static int perl_write_batch(const data_set_t *ds, const value_list_t *vl,
+                            user_data_t *user_data);
+static void perl_write_batch_destroy(void *arg);
+static void *perl_write_batch_thread(void *arg);
 static void perl_log(int level, const char *msg, user_data_t *user_data);
 static int perl_notify(const notification_t *notif, user_data_t *user_data);
 static int perl_flush(cdtime_t timeout, const char *identifier,
@@ -149,6 +155,16 @@ typedef struct {
 
   pthread_mutex_t mutex;
   pthread_mutexattr_t mutexattr;
+
+  /* Interpreters cloned by perl_init() and lent to threads for the duration
+   * of a single callback, see "InterpreterPoolSize". pool[0 .. pool_idle-1]
+   * are available. */
+  c_ithread_t **pool;
+  size_t pool_size;
+  size_t pool_idle;
+  bool pool_shutdown;
+  pthread_mutex_t pool_lock;
+  pthread_cond_t pool_cond;
 } c_ithread_list_t;
 
 /* name / user_data for Perl matches / targets */
@@ -157,6 +173,41 @@ typedef struct {
   SV *user_data;
 } pfc_user_data_t;
 
+/* a value list waiting in a batch writer's queue; "vl.values" is an owned
+ * copy, "vl.meta" is always NULL */
+typedef struct {
+  const data_set_t *ds;
+  value_list_t vl;
+} pwrite_item_t;
+
+/* Writers registered with Collectd::plugin_register_write_batch(). The write
+ * callback only copies the value list into a bounded queue; the writer's own
+ * thread hands whatever has accumulated, up to "batch_size" value lists, to
+ * the Perl sub in a single call. Values are dropped when the queue is full,
+ * so a slow Perl writer does not block the write threads. */
+typedef struct pwrite_batch_s {
+  char *name;
+  char *subname;
+
+  pthread_t thread;
+  bool thread_running;
+  bool free_on_exit;
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pwrite_item_t *queue;
+  size_t queue_limit;
+  size_t queue_head;
+  size_t queue_len;
+  size_t batch_size;
+  bool shutdown;
+
+  uint64_t dropped;
+  c_complain_t complaint;
+
+  struct pwrite_batch_s *next;
+} pwrite_batch_t;
+
 #define PFC_USER_DATA_FREE(data)                                               \
   do {                                                                         \
     sfree((data)->name);                                                       \
@@ -176,6 +227,15 @@ extern char **environ;
 
 static bool register_legacy_flush = true;
 
+/* number of interpreters to clone at init time; 0 gives every thread its
+ * own interpreter */
+static size_t interp_pool_size;
+
+/* all batch writers, so perl_shutdown() can stop them while perl_threads is
+ * still there */
+static pwrite_batch_t *batch_writers;
+static pthread_mutex_t batch_writers_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /* if perl_threads != NULL perl_threads->head must
  * point to the "base" thread */
 static c_ithread_list_t *perl_threads;
@@ -209,6 +269,8 @@ static struct {
     {"Collectd::plugin_dispatch_values", Collectd_plugin_dispatch_values},
     {"Collectd::plugin_get_interval", Collectd_plugin_get_interval},
     {"Collectd::_plugin_write", Collectd__plugin_write},
+    {"Collectd::_plugin_register_write_batch",
+     Collectd__plugin_register_write_batch},
     {"Collectd::_plugin_flush", Collectd__plugin_flush},
     {"Collectd::plugin_dispatch_notification",
      Collectd_plugin_dispatch_notification},
@@ -1274,6 +1336,97 @@ static c_ithread_t *c_ithread_create(PerlInterpreter *base) {
   return t;
 } /* static c_ithread_t *c_ithread_create (PerlInterpreter *) */
 
+/* Clones the interpreters of the pool. Must be called by the base thread
+ * with perl_threads->mutex locked. */
+static int c_ithread_pool_create(size_t num) {
+  c_ithread_t *base = perl_threads->head;
+
+  perl_threads->pool = calloc(num, sizeof(*perl_threads->pool));
+  if (NULL == perl_threads->pool) {
+    log_err("c_ithread_pool_create: calloc failed.");
+    return -1;
+  }
+
+  for (size_t i = 0; i < num; ++i) {
+    perl_threads->pool[i] = c_ithread_create(base->interp);
+  }
+
+  /* perl_clone() and c_ithread_create() switched to the last clone */
+  PERL_SET_CONTEXT(base->interp);
+  pthread_setspecific(perl_thr_key, (const void *)base);
+
+  pthread_mutex_lock(&perl_threads->pool_lock);
+  perl_threads->pool_size = num;
+  perl_threads->pool_idle = num;
+  pthread_mutex_unlock(&perl_threads->pool_lock);
+
+  log_info("Cloned %" PRIsz " Perl interpreters for the interpreter pool.",
+           num);
+  return 0;
+} /* static int c_ithread_pool_create (size_t) */
+
+/* Lends an interpreter of the pool to the calling thread, waiting for one to
+ * become available. Returns NULL on shutdown. */
+static c_ithread_t *c_ithread_borrow(void) {
+  c_ithread_t *t = NULL;
+
+  pthread_mutex_lock(&perl_threads->pool_lock);
+  while (!perl_threads->pool_shutdown && (0 == perl_threads->pool_idle))
+    pthread_cond_wait(&perl_threads->pool_cond, &perl_threads->pool_lock);
+  if (!perl_threads->pool_shutdown)
+    t = perl_threads->pool[--perl_threads->pool_idle];
+  pthread_mutex_unlock(&perl_threads->pool_lock);
+
+  if (NULL == t)
+    return NULL;
+
+  t->pthread = pthread_self();
+  PERL_SET_CONTEXT(t->interp);
+  pthread_setspecific(perl_thr_key, (const void *)t);
+  return t;
+} /* static c_ithread_t *c_ithread_borrow (void) */
+
+/* Hands the interpreter lent to the calling thread back to the pool. */
+static void c_ithread_return(void) {
+  c_ithread_t *t = (c_ithread_t *)pthread_getspecific(perl_thr_key);
+
+  pthread_setspecific(perl_thr_key, NULL);
+  PERL_SET_CONTEXT(NULL);
+
+  if ((NULL == t) || (NULL == perl_threads))
+    return;
+
+  pthread_mutex_lock(&perl_threads->pool_lock);
+  perl_threads->pool[perl_threads->pool_idle++] = t;
+  pthread_cond_signal(&perl_threads->pool_cond);
+  pthread_mutex_unlock(&perl_threads->pool_lock);
+} /* static void c_ithread_return (void) */
+
+/* Returns the interpreter to be used by the calling thread: the one it is
+ * already running, one borrowed from the pool or a new clone of the base
+ * interpreter owned by the thread. If "*borrowed" is set, the interpreter has
+ * to be handed back with c_ithread_return() once the callback is done. */
+static PerlInterpreter *c_ithread_get(bool *borrowed) {
+  dTHX;
+
+  *borrowed = false;
+  if (NULL != aTHX)
+    return aTHX;
+
+  if (0 != perl_threads->pool_size) {
+    c_ithread_t *t = c_ithread_borrow();
+    if (NULL == t)
+      return NULL;
+    *borrowed = true;
+    return t->interp;
+  }
+
+  pthread_mutex_lock(&perl_threads->mutex);
+  c_ithread_t *t = c_ithread_create(perl_threads->head->interp);
+  pthread_mutex_unlock(&perl_threads->mutex);
+  return t->interp;
+} /* static PerlInterpreter *c_ithread_get (bool *) */
+
 /*
  * Filter chains implementation.
  */
@@ -1491,28 +1644,26 @@ static int fc_destroy(int type, void **user_data) {
 static int fc_exec(int type, const data_set_t *ds, const value_list_t *vl,
                    notification_meta_t **meta, void **user_data) {
   pfc_user_data_t *data = *(pfc_user_data_t **)user_data;
-
-  dTHX;
+  bool borrowed;
+  int status;
 
   if (NULL == perl_threads)
     return 0;
 
   assert(NULL != data);
 
-  if (NULL == aTHX) {
-    c_ithread_t *t = NULL;
-
-    pthread_mutex_lock(&perl_threads->mutex);
-    t = c_ithread_create(perl_threads->head->interp);
-    pthread_mutex_unlock(&perl_threads->mutex);
-
-    aTHX = t->interp;
-  }
+  dTHXa(c_ithread_get(&borrowed));
+  if (NULL == aTHX)
+    return 0;
 
   log_debug("fc_exec: c_ithread: interp = %p (active threads: %i)", aTHX,
             perl_threads->number_of_threads);
 
-  return fc_call(aTHX_ type, FC_CB_EXEC, data, ds, vl, meta);
+  status = fc_call(aTHX_ type, FC_CB_EXEC, data, ds, vl, meta);
+
+  if (borrowed)
+    c_ithread_return();
+  return status;
 } /* static int fc_exec (int, const data_set_t *, const value_list_t *,
                 notification_meta_t **, void **) */
 
@@ -1889,6 +2040,101 @@ static XS(Collectd__plugin_write) {
     XSRETURN_EMPTY;
 } /* static XS (Collectd__plugin_write) */
 
+/*
+ * Collectd::_plugin_register_write_batch (pluginname, subname, batch_size,
+ *                                         queue_limit).
+ *
+ * pluginname:
+ *   name of the write callback
+ *
+ * subname:
+ *   name of the sub receiving a reference to an array of
+ *   [ $type, $data_set, $value_list ] entries
+ *
+ * batch_size:
+ *   maximum number of value lists passed to a single call
+ *
+ * queue_limit:
+ *   maximum number of value lists waiting to be written
+ */
+static XS(Collectd__plugin_register_write_batch) {
+  pwrite_batch_t *w;
+  IV batch_size, queue_limit;
+  int status;
+
+  dXSARGS;
+
+  if (4 != items) {
+    log_err("Usage: Collectd::_plugin_register_write_batch(pluginname, "
+            "subname, batch_size, queue_limit)");
+    XSRETURN_EMPTY;
+  }
+
+  if (!SvOK(ST(0)) || !SvOK(ST(1))) {
+    log_err("Collectd::_plugin_register_write_batch: Invalid arguments.");
+    XSRETURN_EMPTY;
+  }
+
+  batch_size = SvIV(ST(2));
+  queue_limit = SvIV(ST(3));
+  if ((batch_size < 1) || (queue_limit < 1)) {
+    log_err("Collectd::_plugin_register_write_batch: batch_size and "
+            "queue_limit must be positive.");
+    XSRETURN_EMPTY;
+  }
+
+  w = calloc(1, sizeof(*w));
+  if (NULL == w) {
+    log_err("Collectd::_plugin_register_write_batch: calloc failed.");
+    XSRETURN_EMPTY;
+  }
+  w->queue = calloc((size_t)queue_limit, sizeof(*w->queue));
+  if (NULL == w->queue) {
+    log_err("Collectd::_plugin_register_write_batch: calloc failed.");
+    sfree(w);
+    XSRETURN_EMPTY;
+  }
+
+  w->name = sstrdup(SvPV_nolen(ST(0)));
+  w->subname = sstrdup(SvPV_nolen(ST(1)));
+  w->batch_size = (size_t)batch_size;
+  w->queue_limit = (size_t)queue_limit;
+  C_COMPLAIN_INIT(&w->complaint);
+  pthread_mutex_init(&w->lock, NULL);
+  pthread_cond_init(&w->cond, NULL);
+
+  log_debug("Collectd::_plugin_register_write_batch: "
+            "plugin = \"%s\", sub = \"%s\"",
+            w->name, w->subname);
+
+  status = plugin_thread_create(&w->thread, perl_write_batch_thread, w,
+                                "perl writer");
+  if (0 != status) {
+    log_err("Collectd::_plugin_register_write_batch: Starting the thread of "
+            "writer \"%s\" failed: %s",
+            w->name, STRERROR(status));
+    perl_write_batch_destroy(w);
+    XSRETURN_EMPTY;
+  }
+  w->thread_running = true;
+
+  pthread_mutex_lock(&batch_writers_lock);
+  w->next = batch_writers;
+  batch_writers = w;
+  pthread_mutex_unlock(&batch_writers_lock);
+
+  status = plugin_register_write(w->name, perl_write_batch,
+                                 &(user_data_t){
+                                     .data = w,
+                                     .free_func = perl_write_batch_destroy,
+                                 });
+
+  if (0 == status)
+    XSRETURN_YES;
+  else
+    XSRETURN_EMPTY;
+} /* static XS (Collectd__plugin_register_write_batch) */
+
 /*
  * Collectd::_plugin_flush (plugin, timeout, identifier).
  *
@@ -2086,26 +2332,27 @@ static int perl_init(void) {
 
   status = pplugin_call(aTHX_ PLUGIN_INIT);
 
+  /* Clone the pool after the init callbacks so that the clones start out
+   * with whatever state these have set up. */
+  if ((0 < interp_pool_size) && (NULL == perl_threads->pool))
+    if (0 != c_ithread_pool_create(interp_pool_size))
+      status = -1;
+
   pthread_mutex_unlock(&perl_threads->mutex);
 
   return status;
 } /* static int perl_init (void) */
 
 static int perl_read(user_data_t *user_data) {
-  dTHX;
+  bool borrowed;
+  int status;
 
   if (NULL == perl_threads)
     return 0;
 
-  if (NULL == aTHX) {
-    c_ithread_t *t = NULL;
-
-    pthread_mutex_lock(&perl_threads->mutex);
-    t = c_ithread_create(perl_threads->head->interp);
-    pthread_mutex_unlock(&perl_threads->mutex);
-
-    aTHX = t->interp;
-  }
+  dTHXa(c_ithread_get(&borrowed));
+  if (NULL == aTHX)
+    return 0;
 
   /* Assert that we're not running as the base thread. Otherwise, we might
    * run into concurrency issues with c_ithread_create(). See
@@ -2115,26 +2362,24 @@ static int perl_read(user_data_t *user_data) {
   log_debug("perl_read: c_ithread: interp = %p (active threads: %i)", aTHX,
             perl_threads->number_of_threads);
 
-  return pplugin_call(aTHX_ PLUGIN_READ, user_data->data);
+  status = pplugin_call(aTHX_ PLUGIN_READ, user_data->data);
+
+  if (borrowed)
+    c_ithread_return();
+  return status;
 } /* static int perl_read (user_data_t *user_data) */
 
 static int perl_write(const data_set_t *ds, const value_list_t *vl,
                       user_data_t *user_data) {
+  bool borrowed;
   int status;
-  dTHX;
 
   if (NULL == perl_threads)
     return 0;
 
-  if (NULL == aTHX) {
-    c_ithread_t *t = NULL;
-
-    pthread_mutex_lock(&perl_threads->mutex);
-    t = c_ithread_create(perl_threads->head->interp);
-    pthread_mutex_unlock(&perl_threads->mutex);
-
-    aTHX = t->interp;
-  }
+  dTHXa(c_ithread_get(&borrowed));
+  if (NULL == aTHX)
+    return 0;
 
   /* Lock the base thread if this is not called from one of the read threads
    * to avoid race conditions with c_ithread_create(). See
@@ -2149,24 +2394,210 @@ static int perl_write(const data_set_t *ds, const value_list_t *vl,
   if (aTHX == perl_threads->head->interp)
     pthread_mutex_unlock(&perl_threads->mutex);
 
+  if (borrowed)
+    c_ithread_return();
   return status;
 } /* static int perl_write (const data_set_t *, const value_list_t *) */
 
-static void perl_log(int level, const char *msg, user_data_t *user_data) {
-  dTHX;
+/* Calls the batch writer's sub with
+ *
+ *   $_[0] = [ [ $type, $data_set, $value_list ], ... ];
+ *
+ * where $data_set and $value_list are the same as for write callbacks. */
+static void perl_write_batch_deliver(pTHX_ pwrite_batch_t *w,
+                                     pwrite_item_t *items, size_t num) {
+  AV *batch = newAV();
+  int retvals;
 
-  if (NULL == perl_threads)
-    return;
+  dSP;
 
-  if (NULL == aTHX) {
-    c_ithread_t *t = NULL;
+  ENTER;
+  SAVETMPS;
 
-    pthread_mutex_lock(&perl_threads->mutex);
-    t = c_ithread_create(perl_threads->head->interp);
-    pthread_mutex_unlock(&perl_threads->mutex);
+  PUSHMARK(SP);
 
-    aTHX = t->interp;
+  for (size_t i = 0; i < num; ++i) {
+    data_set_t *ds = (data_set_t *)items[i].ds;
+    AV *pds = newAV();
+    HV *pvl = newHV();
+    AV *entry;
+
+    if ((-1 == data_set2av(aTHX_ ds, pds)) ||
+        (-1 == value_list2hv(aTHX_ &items[i].vl, ds, pvl))) {
+      SvREFCNT_dec((SV *)pds);
+      SvREFCNT_dec((SV *)pvl);
+      continue;
+    }
+
+    entry = newAV();
+    av_push(entry, newSVpv(ds->type, 0));
+    av_push(entry, newRV_noinc((SV *)pds));
+    av_push(entry, newRV_noinc((SV *)pvl));
+    av_push(batch, newRV_noinc((SV *)entry));
+  }
+
+  XPUSHs(sv_2mortal(newRV_noinc((SV *)batch)));
+
+  PUTBACK;
+
+  retvals = call_pv_locked(aTHX_ w->subname);
+
+  SPAGAIN;
+  if (SvTRUE(ERRSV))
+    ERROR("perl: %s error: %s", w->subname, SvPV_nolen(ERRSV));
+  else if (0 < retvals)
+    (void)POPs;
+
+  PUTBACK;
+  FREETMPS;
+  LEAVE;
+} /* static void perl_write_batch_deliver (pTHX_ pwrite_batch_t *, ...) */
+
+static void perl_write_batch_free(pwrite_batch_t *w) {
+  pthread_mutex_lock(&batch_writers_lock);
+  for (pwrite_batch_t **p = &batch_writers; NULL != *p; p = &(*p)->next) {
+    if (*p == w) {
+      *p = w->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&batch_writers_lock);
+
+  for (size_t i = 0; i < w->queue_len; ++i)
+    sfree(w->queue[(w->queue_head + i) % w->queue_limit].vl.values);
+  sfree(w->queue);
+  pthread_mutex_destroy(&w->lock);
+  pthread_cond_destroy(&w->cond);
+
+  if (0 < w->dropped)
+    log_warn("Batch writer \"%s\" dropped %" PRIu64 " value lists because "
+             "its queue was full.",
+             w->name, w->dropped);
+
+  sfree(w->name);
+  sfree(w->subname);
+  sfree(w);
+} /* static void perl_write_batch_free (pwrite_batch_t *) */
+
+static void *perl_write_batch_thread(void *arg) {
+  pwrite_batch_t *w = arg;
+  pwrite_item_t *batch;
+  bool free_on_exit;
+
+  batch = calloc(w->batch_size, sizeof(*batch));
+  if (NULL == batch) {
+    log_err("perl_write_batch_thread: calloc failed.");
+    return NULL;
+  }
+
+  pthread_mutex_lock(&w->lock);
+  while (true) {
+    bool borrowed = false;
+    PerlInterpreter *interp = NULL;
+    size_t num;
+
+    while (!w->shutdown && (0 == w->queue_len))
+      pthread_cond_wait(&w->cond, &w->lock);
+    if (0 == w->queue_len)
+      break;
+
+    num = w->queue_len;
+    if (num > w->batch_size)
+      num = w->batch_size;
+    for (size_t i = 0; i < num; ++i)
+      batch[i] = w->queue[(w->queue_head + i) % w->queue_limit];
+    w->queue_head = (w->queue_head + num) % w->queue_limit;
+    w->queue_len -= num;
+    pthread_mutex_unlock(&w->lock);
+
+    if (NULL != perl_threads)
+      interp = c_ithread_get(&borrowed);
+    if (NULL != interp) {
+      perl_write_batch_deliver(interp, w, batch, num);
+      if (borrowed)
+        c_ithread_return();
+    }
+
+    for (size_t i = 0; i < num; ++i)
+      sfree(batch[i].vl.values);
+
+    pthread_mutex_lock(&w->lock);
+  }
+  free_on_exit = w->free_on_exit;
+  pthread_mutex_unlock(&w->lock);
+
+  sfree(batch);
+  if (free_on_exit)
+    perl_write_batch_free(w);
+  return NULL;
+} /* static void *perl_write_batch_thread (void *) */
+
+static int perl_write_batch(const data_set_t *ds, const value_list_t *vl,
+                            user_data_t *user_data) {
+  pwrite_batch_t *w = user_data->data;
+
+  /* meta data is never handed to the sub */
+  pwrite_item_t item = {.ds = ds, .vl = *vl};
+  item.vl.meta = NULL;
+  item.vl.values = malloc(vl->values_len * sizeof(*vl->values));
+  if (NULL == item.vl.values) {
+    log_err("perl_write_batch: malloc failed.");
+    return ENOMEM;
+  }
+  memcpy(item.vl.values, vl->values, vl->values_len * sizeof(*vl->values));
+
+  pthread_mutex_lock(&w->lock);
+  if (w->queue_len >= w->queue_limit) {
+    w->dropped++;
+    pthread_mutex_unlock(&w->lock);
+    c_complain(LOG_WARNING, &w->complaint,
+               "perl: The queue of batch writer \"%s\" is full, dropping "
+               "values.",
+               w->name);
+    sfree(item.vl.values);
+    return ENOBUFS;
+  }
+  w->queue[(w->queue_head + w->queue_len) % w->queue_limit] = item;
+  w->queue_len++;
+  pthread_cond_signal(&w->cond);
+  pthread_mutex_unlock(&w->lock);
+
+  c_release(LOG_INFO, &w->complaint,
+            "perl: The queue of batch writer \"%s\" accepts values again.",
+            w->name);
+  return 0;
+} /* static int perl_write_batch (const data_set_t *, const value_list_t *) */
+
+static void perl_write_batch_destroy(void *arg) {
+  pwrite_batch_t *w = arg;
+
+  pthread_mutex_lock(&w->lock);
+  w->shutdown = true;
+  pthread_cond_signal(&w->cond);
+  if (w->thread_running && pthread_equal(pthread_self(), w->thread)) {
+    /* Collectd::plugin_unregister_write called from the writer's own sub */
+    w->free_on_exit = true;
+    pthread_mutex_unlock(&w->lock);
+    pthread_detach(w->thread);
+    return;
   }
+  pthread_mutex_unlock(&w->lock);
+
+  if (w->thread_running)
+    pthread_join(w->thread, NULL);
+
+  perl_write_batch_free(w);
+} /* static void perl_write_batch_destroy (void *) */
+
+static void perl_log(int level, const char *msg, user_data_t *user_data) {
+  bool borrowed;
+
+  if (NULL == perl_threads)
+    return;
+
+  dTHXa(c_ithread_get(&borrowed));
+  if (NULL == aTHX)
+    return;
 
   /* Lock the base thread if this is not called from one of the read threads
    * to avoid race conditions with c_ithread_create(). See
@@ -2181,49 +2612,51 @@ static void perl_log(int level, const char *msg, user_data_t *user_data) {
   if (aTHX == perl_threads->head->interp)
     pthread_mutex_unlock(&perl_threads->mutex);
 
+  if (borrowed)
+    c_ithread_return();
   return;
 } /* static void perl_log (int, const char *) */
 
 static int perl_notify(const notification_t *notif, user_data_t *user_data) {
-  dTHX;
+  bool borrowed;
+  int status;
 
   if (NULL == perl_threads)
     return 0;
 
-  if (NULL == aTHX) {
-    c_ithread_t *t = NULL;
+  dTHXa(c_ithread_get(&borrowed));
+  if (NULL == aTHX)
+    return 0;
 
-    pthread_mutex_lock(&perl_threads->mutex);
-    t = c_ithread_create(perl_threads->head->interp);
-    pthread_mutex_unlock(&perl_threads->mutex);
+  status = pplugin_call(aTHX_ PLUGIN_NOTIF, user_data->data, notif);
 
-    aTHX = t->interp;
-  }
-  return pplugin_call(aTHX_ PLUGIN_NOTIF, user_data->data, notif);
+  if (borrowed)
+    c_ithread_return();
+  return status;
 } /* static int perl_notify (const notification_t *) */
 
 static int perl_flush(cdtime_t timeout, const char *identifier,
                       user_data_t *user_data) {
-  dTHX;
+  bool borrowed;
+  int status;
 
   if (NULL == perl_threads)
     return 0;
 
-  if (NULL == aTHX) {
-    c_ithread_t *t = NULL;
-
-    pthread_mutex_lock(&perl_threads->mutex);
-    t = c_ithread_create(perl_threads->head->interp);
-    pthread_mutex_unlock(&perl_threads->mutex);
-
-    aTHX = t->interp;
-  }
+  dTHXa(c_ithread_get(&borrowed));
+  if (NULL == aTHX)
+    return 0;
 
   /* For collectd-5.6 only, #1731 */
   if (user_data == NULL || user_data->data == NULL)
-    return pplugin_call(aTHX_ PLUGIN_FLUSH_ALL, timeout, identifier);
+    status = pplugin_call(aTHX_ PLUGIN_FLUSH_ALL, timeout, identifier);
+  else
+    status =
+        pplugin_call(aTHX_ PLUGIN_FLUSH, user_data->data, timeout, identifier);
 
-  return pplugin_call(aTHX_ PLUGIN_FLUSH, user_data->data, timeout, identifier);
+  if (borrowed)
+    c_ithread_return();
+  return status;
 } /* static int perl_flush (const int) */
 
 static int perl_shutdown(void) {
@@ -2252,8 +2685,32 @@ static int perl_shutdown(void) {
   plugin_unregister_init("perl");
   plugin_unregister_flush("perl"); /* For collectd-5.6 only, #1731 */
 
+  /* the batch threads borrow interpreters from perl_threads to empty their
+   * queues, so join them before the pool is shut down below */
+  while (true) {
+    char *name;
+
+    pthread_mutex_lock(&batch_writers_lock);
+    if (NULL == batch_writers) {
+      pthread_mutex_unlock(&batch_writers_lock);
+      break;
+    }
+    name = sstrdup(batch_writers->name);
+    batch_writers = batch_writers->next;
+    pthread_mutex_unlock(&batch_writers_lock);
+
+    plugin_unregister_write(name);
+    sfree(name);
+  }
+
   ret = pplugin_call(aTHX_ PLUGIN_SHUTDOWN);
 
+  /* wake up threads waiting for a pooled interpreter */
+  pthread_mutex_lock(&perl_threads->pool_lock);
+  perl_threads->pool_shutdown = true;
+  pthread_cond_broadcast(&perl_threads->pool_cond);
+  pthread_mutex_unlock(&perl_threads->pool_lock);
+
   pthread_mutex_lock(&perl_threads->mutex);
   t = perl_threads->tail;
 
@@ -2283,7 +2740,10 @@ static int perl_shutdown(void) {
   pthread_mutex_unlock(&perl_threads->mutex);
   pthread_mutex_destroy(&perl_threads->mutex);
   pthread_mutexattr_destroy(&perl_threads->mutexattr);
+  pthread_mutex_destroy(&perl_threads->pool_lock);
+  pthread_cond_destroy(&perl_threads->pool_cond);
 
+  sfree(perl_threads->pool);
   sfree(perl_threads);
 
   pthread_key_delete(perl_thr_key);
@@ -2435,6 +2895,8 @@ static int init_pi(int argc, char **argv) {
   pthread_mutexattr_init(&perl_threads->mutexattr);
   pthread_mutexattr_settype(&perl_threads->mutexattr, PTHREAD_MUTEX_RECURSIVE);
   pthread_mutex_init(&perl_threads->mutex, &perl_threads->mutexattr);
+  pthread_mutex_init(&perl_threads->pool_lock, NULL);
+  pthread_cond_init(&perl_threads->pool_cond, NULL);
   /* locking the mutex should not be necessary at this point
    * but let's just do it for the sake of completeness */
   pthread_mutex_lock(&perl_threads->mutex);
@@ -2689,6 +3151,15 @@ static int perl_config(oconfig_item_t *ci) {
       current_status = perl_config_plugin(aTHX_ c);
     else if (0 == strcasecmp(c->key, "RegisterLegacyFlush"))
       cf_util_get_boolean(c, &register_legacy_flush);
+    else if (0 == strcasecmp(c->key, "InterpreterPoolSize")) {
+      int tmp = 0;
+      current_status = cf_util_get_int(c, &tmp);
+      if ((0 == current_status) && (0 > tmp)) {
+        log_err("InterpreterPoolSize must not be negative.");
+        current_status = 1;
+      } else if (0 == current_status)
+        interp_pool_size = (size_t)tmp;
+    }
     else {
       log_warn("Ignoring unknown config key \"%s\".", c->key);
       current_status = 0;
@@ -23,6 +23,8 @@
  *   Florian Forster <octo at collectd.org>
  **/
 
+#define _GNU_SOURCE /* For recvmmsg */
+
 #include "collectd.h"
 
 #include "plugin.h"
@@ -57,6 +59,13 @@
 #define PINBA_MAX_SOCKETS 16
 #endif
 
+/* Maximum number of datagrams received with one recvmmsg(2) call. */
+#ifndef PINBA_RECEIVE_BATCH
+#define PINBA_RECEIVE_BATCH 32
+#endif
+
+#define PINBA_ARENA_BLOCK_SIZE 65536
+
 /*
  * Private data structures
  */
@@ -74,6 +83,18 @@ struct float_counter_s {
 };
 typedef struct float_counter_s float_counter_t;
 
+struct pinba_counters_s {
+  derive_t req_count;
+
+  float_counter_t req_time;
+  float_counter_t ru_utime;
+  float_counter_t ru_stime;
+
+  derive_t doc_size;
+  gauge_t mem_peak;
+};
+typedef struct pinba_counters_s pinba_counters_t;
+
 struct pinba_statnode_s {
   /* collector name, used as plugin instance */
   char *name;
@@ -83,16 +104,38 @@ struct pinba_statnode_s {
   char *server;
   char *script;
 
-  derive_t req_count;
-
-  float_counter_t req_time;
-  float_counter_t ru_utime;
-  float_counter_t ru_stime;
-
-  derive_t doc_size;
-  gauge_t mem_peak;
+  pinba_counters_t counters;
 };
 typedef struct pinba_statnode_s pinba_statnode_t;
+
+/* Decoded requests are allocated from blocks that are reused for the next
+ * batch of datagrams instead of being freed piece by piece. */
+struct pinba_arena_block_s {
+  struct pinba_arena_block_s *next;
+  size_t size;
+  size_t used;
+};
+typedef struct pinba_arena_block_s pinba_arena_block_t;
+
+/* Every receive thread has its own copy of the listen sockets and accumulates
+ * the requests it receives in its own counters, one per view, which are
+ * merged into "stat_nodes" when reading. With more than one thread the
+ * sockets are bound with SO_REUSEPORT, so that the kernel spreads the senders
+ * over the threads. "lock" is held while a batch of datagrams is processed and
+ * while merging, i.e. it is only contended once per interval. */
+struct pinba_receiver_s {
+  pthread_t thread;
+  bool thread_running;
+
+  pthread_mutex_t lock;
+  pinba_counters_t *counters;
+
+  uint8_t *buffers;
+  pinba_arena_block_t *arena;
+  size_t arena_size;
+  ProtobufCAllocator allocator;
+};
+typedef struct pinba_receiver_s pinba_receiver_t;
 /* }}} */
 
 /*
@@ -105,10 +148,11 @@ static pthread_mutex_t stat_nodes_lock;
 
 static char *conf_node;
 static char *conf_service;
+static size_t conf_receive_threads = 1;
 
-static bool collector_thread_running;
+static pinba_receiver_t *receivers;
+static size_t receivers_num;
 static bool collector_thread_do_shutdown;
-static pthread_t collector_thread_id;
 /* }}} */
 
 /*
@@ -134,6 +178,17 @@ static void float_counter_add(float_counter_t *fc, float val) /* {{{ */
   }
 } /* }}} void float_counter_add */
 
+static void float_counter_merge(float_counter_t *dst, /* {{{ */
+                                const float_counter_t *src) {
+  dst->i += src->i;
+  dst->n += src->n;
+
+  if (dst->n >= 1000000000) {
+    dst->i += 1;
+    dst->n -= 1000000000;
+  }
+} /* }}} void float_counter_merge */
+
 static derive_t float_counter_get(const float_counter_t *fc, /* {{{ */
                                   uint64_t factor) {
   derive_t ret;
@@ -180,7 +235,7 @@ static void service_statnode_add(const char *name, /* {{{ */
   node->server = NULL;
   node->script = NULL;
 
-  node->mem_peak = NAN;
+  node->counters.mem_peak = NAN;
 
   /* fill query data */
   strset(&node->name, name);
@@ -192,6 +247,38 @@ static void service_statnode_add(const char *name, /* {{{ */
   stat_nodes_num++;
 } /* }}} void service_statnode_add */
 
+static void service_counters_merge(pinba_counters_t *dst, /* {{{ */
+                                   pinba_counters_t *src) {
+  dst->req_count += src->req_count;
+
+  float_counter_merge(&dst->req_time, &src->req_time);
+  float_counter_merge(&dst->ru_utime, &src->ru_utime);
+  float_counter_merge(&dst->ru_stime, &src->ru_stime);
+
+  dst->doc_size += src->doc_size;
+
+  if (isnan(dst->mem_peak) ||
+      (!isnan(src->mem_peak) && (dst->mem_peak < src->mem_peak)))
+    dst->mem_peak = src->mem_peak;
+
+  memset(src, 0, sizeof(*src));
+  src->mem_peak = NAN;
+} /* }}} void service_counters_merge */
+
+/* Adds the requests accumulated by the receive threads to "stat_nodes". Must
+ * be called with "stat_nodes_lock" held. */
+static void service_statnode_merge(void) /* {{{ */
+{
+  for (size_t i = 0; i < receivers_num; i++) {
+    pinba_receiver_t *r = receivers + i;
+
+    pthread_mutex_lock(&r->lock);
+    for (unsigned int j = 0; j < stat_nodes_num; j++)
+      service_counters_merge(&stat_nodes[j].counters, r->counters + j);
+    pthread_mutex_unlock(&r->lock);
+  }
+} /* }}} void service_statnode_merge */
+
 /* Copy the data from the global "stat_nodes" list into the buffer pointed to
  * by "res", doing the derivation in the process. Returns the next index or
  * zero if the end of the list has been reached. */
@@ -203,8 +290,10 @@ static unsigned int service_statnode_collect(pinba_statnode_t *res, /* {{{ */
     return 0;
 
   /* begin collecting */
-  if (index == 0)
+  if (index == 0) {
     pthread_mutex_lock(&stat_nodes_lock);
+    service_statnode_merge();
+  }
 
   /* end collecting */
   if (index >= stat_nodes_num) {
@@ -216,31 +305,31 @@ static unsigned int service_statnode_collect(pinba_statnode_t *res, /* {{{ */
   memcpy(res, node, sizeof(*res));
 
   /* reset node */
-  node->mem_peak = NAN;
+  node->counters.mem_peak = NAN;
 
   return index + 1;
 } /* }}} unsigned int service_statnode_collect */
 
-static void service_statnode_process(pinba_statnode_t *node, /* {{{ */
+static void service_statnode_process(pinba_counters_t *c, /* {{{ */
                                      Pinba__Request *request) {
-  node->req_count++;
+  c->req_count++;
 
-  float_counter_add(&node->req_time, request->request_time);
-  float_counter_add(&node->ru_utime, request->ru_utime);
-  float_counter_add(&node->ru_stime, request->ru_stime);
+  float_counter_add(&c->req_time, request->request_time);
+  float_counter_add(&c->ru_utime, request->ru_utime);
+  float_counter_add(&c->ru_stime, request->ru_stime);
 
-  node->doc_size += request->document_size;
+  c->doc_size += request->document_size;
 
-  if (isnan(node->mem_peak) ||
-      (node->mem_peak < ((gauge_t)request->memory_peak)))
-    node->mem_peak = (gauge_t)request->memory_peak;
+  if (isnan(c->mem_peak) || (c->mem_peak < ((gauge_t)request->memory_peak)))
+    c->mem_peak = (gauge_t)request->memory_peak;
 
 } /* }}} void service_statnode_process */
 
-static void service_process_request(Pinba__Request *request) /* {{{ */
-{
-  pthread_mutex_lock(&stat_nodes_lock);
-
+/* The views are not changed after the configuration has been read, so they
+ * are matched without holding "stat_nodes_lock". Must be called with the
+ * receiver's lock held. */
+static void service_process_request(pinba_receiver_t *r, /* {{{ */
+                                    Pinba__Request *request) {
   for (unsigned int i = 0; i < stat_nodes_num; i++) {
     if ((stat_nodes[i].host != NULL) &&
         (strcmp(request->hostname, stat_nodes[i].host) != 0))
@@ -254,10 +343,8 @@ static void service_process_request(Pinba__Request *request) /* {{{ */
         (strcmp(request->script_name, stat_nodes[i].script) != 0))
       continue;
 
-    service_statnode_process(&stat_nodes[i], request);
+    service_statnode_process(r->counters + i, request);
   }
-
-  pthread_mutex_unlock(&stat_nodes_lock);
 } /* }}} void service_process_request */
 
 static int pb_del_socket(pinba_socket_t *s, /* {{{ */
@@ -279,7 +366,7 @@ static int pb_del_socket(pinba_socket_t *s, /* {{{ */
 } /* }}} int pb_del_socket */
 
 static int pb_add_socket(pinba_socket_t *s, /* {{{ */
-                         const struct addrinfo *ai) {
+                         const struct addrinfo *ai, bool reuseport) {
 
   if (s->fd_num == PINBA_MAX_SOCKETS) {
     WARNING("pinba plugin: Sorry, you have hit the built-in limit of "
@@ -300,6 +387,18 @@ static int pb_add_socket(pinba_socket_t *s, /* {{{ */
     WARNING("pinba plugin: setsockopt(SO_REUSEADDR) failed: %s", STRERRNO);
   }
 
+#ifdef SO_REUSEPORT
+  /* let the kernel balance the datagrams over the receive threads */
+  if (reuseport &&
+      (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &(int){1}, sizeof(int)) != 0)) {
+    ERROR("pinba plugin: setsockopt(SO_REUSEPORT) failed: %s", STRERRNO);
+    close(fd);
+    return 0;
+  }
+#else
+  assert(!reuseport);
+#endif
+
   status = bind(fd, ai->ai_addr, ai->ai_addrlen);
   if (status != 0) {
     ERROR("pinba plugin: bind(2) failed: %s", STRERRNO);
@@ -316,7 +415,7 @@ static int pb_add_socket(pinba_socket_t *s, /* {{{ */
 } /* }}} int pb_add_socket */
 
 static pinba_socket_t *pinba_socket_open(const char *node, /* {{{ */
-                                         const char *service) {
+                                         const char *service, bool reuseport) {
   pinba_socket_t *s;
   struct addrinfo *ai_list;
   int status;
@@ -347,7 +446,7 @@ static pinba_socket_t *pinba_socket_open(const char *node, /* {{{ */
 
   for (struct addrinfo *ai_ptr = ai_list; ai_ptr != NULL;
        ai_ptr = ai_ptr->ai_next) {
-    status = pb_add_socket(s, ai_ptr);
+    status = pb_add_socket(s, ai_ptr, reuseport);
     if (status != 0)
       break;
   } /* for (ai_list) */
@@ -378,69 +477,175 @@ static void pinba_socket_free(pinba_socket_t *socket) /* {{{ */
   sfree(socket);
 } /* }}} void pinba_socket_free */
 
-static int pinba_process_stats_packet(const uint8_t *buffer, /* {{{ */
+static size_t pinba_arena_header_size(void) /* {{{ */
+{
+  /* Keep the allocations aligned like malloc(3) does. */
+  return (sizeof(pinba_arena_block_t) + 15) & ~((size_t)15);
+} /* }}} size_t pinba_arena_header_size */
+
+static void *pinba_arena_alloc(void *data, size_t size) /* {{{ */
+{
+  pinba_receiver_t *r = data;
+  pinba_arena_block_t *b = r->arena;
+
+  size = (size + 15) & ~((size_t)15);
+
+  if ((b == NULL) || ((b->size - b->used) < size)) {
+    size_t block_size =
+        (size > PINBA_ARENA_BLOCK_SIZE) ? size : PINBA_ARENA_BLOCK_SIZE;
+
+    b = malloc(pinba_arena_header_size() + block_size);
+    if (b == NULL)
+      return NULL;
+    b->next = r->arena;
+    b->size = block_size;
+    b->used = 0;
+
+    r->arena = b;
+    r->arena_size += block_size;
+  }
+
+  void *ptr = ((char *)b) + pinba_arena_header_size() + b->used;
+  b->used += size;
+  return ptr;
+} /* }}} void *pinba_arena_alloc */
+
+/* Memory is released by pinba_arena_reset(). */
+static void pinba_arena_free(__attribute__((unused)) void *data, /* {{{ */
+                             __attribute__((unused)) void *ptr) {
+} /* }}} void pinba_arena_free */
+
+static void pinba_arena_destroy(pinba_receiver_t *r) /* {{{ */
+{
+  while (r->arena != NULL) {
+    pinba_arena_block_t *next = r->arena->next;
+    free(r->arena);
+    r->arena = next;
+  }
+  r->arena_size = 0;
+} /* }}} void pinba_arena_destroy */
+
+/* Makes all memory of the arena available again. If the last batch needed
+ * more than one block, the blocks are replaced by a single one that is large
+ * enough, so that the next batches are served from one block. */
+static void pinba_arena_reset(pinba_receiver_t *r) /* {{{ */
+{
+  if (r->arena == NULL)
+    return;
+
+  if (r->arena->next != NULL) {
+    size_t size = r->arena_size;
+
+    pinba_arena_destroy(r);
+
+    pinba_arena_block_t *b = malloc(pinba_arena_header_size() + size);
+    if (b == NULL)
+      return;
+    b->next = NULL;
+    b->size = size;
+    r->arena = b;
+    r->arena_size = size;
+  }
+
+  r->arena->used = 0;
+} /* }}} void pinba_arena_reset */
+
+static int pinba_process_stats_packet(pinba_receiver_t *r, /* {{{ */
+                                      const uint8_t *buffer,
                                       size_t buffer_size) {
   Pinba__Request *request;
 
-  request = pinba__request__unpack(NULL, buffer_size, buffer);
+  /* The request is freed by resetting the arena. */
+  request = pinba__request__unpack(&r->allocator, buffer_size, buffer);
 
   if (!request)
     return -1;
 
-  service_process_request(request);
-  pinba__request__free_unpacked(request, NULL);
+  service_process_request(r, request);
 
   return 0;
 } /* }}} int pinba_process_stats_packet */
 
-static int pinba_udp_read_callback_fn(int sock) /* {{{ */
+/* Receives a batch of datagrams from "sock" and processes them. */
+static int pinba_udp_read_callback_fn(pinba_receiver_t *r, int sock) /* {{{ */
 {
-  uint8_t buffer[PINBA_UDP_BUFFER_SIZE];
-  size_t buffer_size;
-  int status;
+  size_t sizes[PINBA_RECEIVE_BATCH];
+  size_t num;
+
+#if HAVE_RECVMMSG
+  struct mmsghdr msgs[PINBA_RECEIVE_BATCH];
+  struct iovec iovs[PINBA_RECEIVE_BATCH];
+
+  for (size_t i = 0; i < PINBA_RECEIVE_BATCH; i++) {
+    iovs[i] = (struct iovec){
+        .iov_base = r->buffers + i * PINBA_UDP_BUFFER_SIZE,
+        .iov_len = PINBA_UDP_BUFFER_SIZE,
+    };
+    msgs[i] = (struct mmsghdr){
+        .msg_hdr =
+            {
+                .msg_iov = iovs + i,
+                .msg_iovlen = 1,
+            },
+    };
+  }
 
-  while (42) {
-    buffer_size = sizeof(buffer);
-    status = recvfrom(sock, buffer, buffer_size - 1, MSG_DONTWAIT,
-                      /* from = */ NULL, /* from len = */ 0);
-    if (status < 0) {
+  int status;
+  do {
+    status = recvmmsg(sock, msgs, PINBA_RECEIVE_BATCH,
+                      /* flags = */ MSG_DONTWAIT, /* timeout = */ NULL);
+  } while ((status < 0) && (errno == EINTR));
+#else
+  ssize_t status;
+  do {
+    status = recv(sock, r->buffers, PINBA_UDP_BUFFER_SIZE, MSG_DONTWAIT);
+  } while ((status < 0) && (errno == EINTR));
+#endif
 
-      if ((errno == EINTR)
+  if (status < 0) {
+    if ((errno == EAGAIN)
 #ifdef EWOULDBLOCK
-          || (errno == EWOULDBLOCK)
+        || (errno == EWOULDBLOCK)
 #endif
-          || (errno == EAGAIN)) {
-        continue;
-      }
+    )
+      return 0;
 
-      WARNING("pinba plugin: recvfrom(2) failed: %s", STRERRNO);
-      return -1;
-    } else if (status == 0) {
-      DEBUG("pinba plugin: recvfrom(2) returned unexpected status zero.");
-      return -1;
-    } else /* if (status > 0) */
-    {
-      assert(((size_t)status) < buffer_size);
-      buffer_size = (size_t)status;
-      buffer[buffer_size] = 0;
-
-      status = pinba_process_stats_packet(buffer, buffer_size);
-      if (status != 0)
-        DEBUG("pinba plugin: Parsing packet failed.");
-      return status;
+    WARNING("pinba plugin: Receiving datagrams failed: %s", STRERRNO);
+    return -1;
+  }
+
+#if HAVE_RECVMMSG
+  num = (size_t)status;
+  for (size_t i = 0; i < num; i++)
+    sizes[i] = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) ? 0 : msgs[i].msg_len;
+#else
+  num = 1;
+  sizes[0] = (size_t)status;
+#endif
+
+  pthread_mutex_lock(&r->lock);
+  for (size_t i = 0; i < num; i++) {
+    if (sizes[i] == 0) {
+      DEBUG("pinba plugin: Ignoring empty or truncated datagram.");
+      continue;
     }
-  } /* while (42) */
 
-  /* not reached */
-  assert(23 == 42);
-  return -1;
-} /* }}} void pinba_udp_read_callback_fn */
+    status = pinba_process_stats_packet(
+        r, r->buffers + i * PINBA_UDP_BUFFER_SIZE, sizes[i]);
+    if (status != 0)
+      DEBUG("pinba plugin: Parsing packet failed.");
+  }
+  pthread_mutex_unlock(&r->lock);
+
+  pinba_arena_reset(r);
+  return 0;
+} /* }}} int pinba_udp_read_callback_fn */
 
-static int receive_loop(void) /* {{{ */
+static int receive_loop(pinba_receiver_t *r) /* {{{ */
 {
   pinba_socket_t *s;
 
-  s = pinba_socket_open(conf_node, conf_service);
+  s = pinba_socket_open(conf_node, conf_service, receivers_num > 1);
   if (s == NULL) {
     ERROR("pinba plugin: Collector thread is exiting prematurely.");
     return -1;
@@ -470,7 +675,7 @@ static int receive_loop(void) /* {{{ */
         pb_del_socket(s, i);
         i--;
       } else if (s->fd[i].revents & (POLLIN | POLLPRI)) {
-        pinba_udp_read_callback_fn(s->fd[i].fd);
+        pinba_udp_read_callback_fn(r, s->fd[i].fd);
       }
     } /* for (s->fd) */
   }   /* while (!collector_thread_do_shutdown) */
@@ -483,10 +688,18 @@ static int receive_loop(void) /* {{{ */
 
 static void *collector_thread(void *arg) /* {{{ */
 {
-  receive_loop();
+  pinba_receiver_t *r = arg;
 
-  memset(&collector_thread_id, 0, sizeof(collector_thread_id));
-  collector_thread_running = false;
+  r->buffers = malloc(PINBA_RECEIVE_BATCH * PINBA_UDP_BUFFER_SIZE);
+  if (r->buffers == NULL) {
+    ERROR("pinba plugin: malloc failed.");
+    pthread_exit(NULL);
+  }
+
+  receive_loop(r);
+
+  sfree(r->buffers);
+  pinba_arena_destroy(r);
   pthread_exit(NULL);
   return NULL;
 } /* }}} void *collector_thread */
@@ -535,6 +748,31 @@ static int pinba_config_view(const oconfig_item_t *ci) /* {{{ */
   return status;
 } /* }}} int pinba_config_view */
 
+static int pinba_config_receive_threads(oconfig_item_t *ci) /* {{{ */
+{
+  int tmp = 0;
+
+  if (cf_util_get_int(ci, &tmp) != 0)
+    return -1;
+
+  if (tmp < 1) {
+    ERROR("pinba plugin: The \"%s\" option must be positive.", ci->key);
+    return ERANGE;
+  }
+
+#ifndef SO_REUSEPORT
+  if (tmp > 1) {
+    WARNING("pinba plugin: \"%s\" requires SO_REUSEPORT, which is not "
+            "available on this system. Using one receive thread.",
+            ci->key);
+    tmp = 1;
+  }
+#endif
+
+  conf_receive_threads = (size_t)tmp;
+  return 0;
+} /* }}} int pinba_config_receive_threads */
+
 static int plugin_config(oconfig_item_t *ci) /* {{{ */
 {
   /* The lock should not be necessary in the config callback, but let's be
@@ -548,6 +786,8 @@ static int plugin_config(oconfig_item_t *ci) /* {{{ */
       cf_util_get_string(child, &conf_node);
     else if (strcasecmp("Port", child->key) == 0)
       cf_util_get_service(child, &conf_service);
+    else if (strcasecmp("ReceiveThreads", child->key) == 0)
+      pinba_config_receive_threads(child);
     else if (strcasecmp("View", child->key) == 0)
       pinba_config_view(child);
     else
@@ -571,36 +811,77 @@ static int plugin_init(void) /* {{{ */
                          /* script = */ NULL);
   }
 
-  if (collector_thread_running)
-    return 0;
+  if (receivers == NULL) {
+    receivers = calloc(conf_receive_threads, sizeof(*receivers));
+    if (receivers == NULL) {
+      ERROR("pinba plugin: calloc failed.");
+      return ENOMEM;
+    }
+    receivers_num = conf_receive_threads;
 
-  status = plugin_thread_create(&collector_thread_id, collector_thread,
-                                /* args = */ NULL, "pinba collector");
-  if (status != 0) {
-    ERROR("pinba plugin: pthread_create(3) failed: %s", STRERRNO);
-    return -1;
+    for (size_t i = 0; i < receivers_num; i++) {
+      pinba_receiver_t *r = receivers + i;
+
+      r->counters = calloc(stat_nodes_num, sizeof(*r->counters));
+      if (r->counters == NULL) {
+        ERROR("pinba plugin: calloc failed.");
+        return ENOMEM;
+      }
+      for (unsigned int j = 0; j < stat_nodes_num; j++)
+        r->counters[j].mem_peak = NAN;
+
+      pthread_mutex_init(&r->lock, /* attr = */ NULL);
+      r->allocator = (ProtobufCAllocator){
+          .alloc = pinba_arena_alloc,
+          .free = pinba_arena_free,
+          .allocator_data = r,
+      };
+    }
+  }
+
+  for (size_t i = 0; i < receivers_num; i++) {
+    pinba_receiver_t *r = receivers + i;
+
+    if (r->thread_running)
+      continue;
+
+    status = plugin_thread_create(&r->thread, collector_thread,
+                                  /* args = */ r, "pinba collector");
+    if (status != 0) {
+      ERROR("pinba plugin: pthread_create(3) failed: %s", STRERRNO);
+      return -1;
+    }
+    r->thread_running = true;
   }
-  collector_thread_running = true;
 
   return 0;
 } /* }}} */
 
 static int plugin_shutdown(void) /* {{{ */
 {
-  if (collector_thread_running) {
-    int status;
+  DEBUG("pinba plugin: Shutting down collector threads.");
+  collector_thread_do_shutdown = true;
 
-    DEBUG("pinba plugin: Shutting down collector thread.");
-    collector_thread_do_shutdown = true;
+  for (size_t i = 0; i < receivers_num; i++) {
+    pinba_receiver_t *r = receivers + i;
 
-    status = pthread_join(collector_thread_id, /* retval = */ NULL);
+    if (!r->thread_running)
+      continue;
+
+    int status = pthread_join(r->thread, /* retval = */ NULL);
     if (status != 0) {
       ERROR("pinba plugin: pthread_join(3) failed: %s", STRERROR(status));
     }
+    r->thread_running = false;
+  }
+  collector_thread_do_shutdown = false;
 
-    collector_thread_running = false;
-    collector_thread_do_shutdown = false;
-  } /* if (collector_thread_running) */
+  for (size_t i = 0; i < receivers_num; i++) {
+    sfree(receivers[i].counters);
+    pthread_mutex_destroy(&receivers[i].lock);
+  }
+  sfree(receivers);
+  receivers_num = 0;
 
   return 0;
 } /* }}} int plugin_shutdown */
@@ -613,32 +894,32 @@ static int plugin_submit(const pinba_statnode_t *res) /* {{{ */
   sstrncpy(vl.plugin, "pinba", sizeof(vl.plugin));
   sstrncpy(vl.plugin_instance, res->name, sizeof(vl.plugin_instance));
 
-  vl.values = &(value_t){.derive = res->req_count};
+  vl.values = &(value_t){.derive = res->counters.req_count};
   sstrncpy(vl.type, "total_requests", sizeof(vl.type));
   plugin_dispatch_values(&vl);
 
-  vl.values = &(value_t){
-      .derive = float_counter_get(&res->req_time, /* factor = */ 1000)};
+  vl.values = &(value_t){.derive = float_counter_get(&res->counters.req_time,
+                                                    /* factor = */ 1000)};
   sstrncpy(vl.type, "total_time_in_ms", sizeof(vl.type));
   plugin_dispatch_values(&vl);
 
-  vl.values = &(value_t){.derive = res->doc_size};
+  vl.values = &(value_t){.derive = res->counters.doc_size};
   sstrncpy(vl.type, "total_bytes", sizeof(vl.type));
   plugin_dispatch_values(&vl);
 
-  vl.values = &(value_t){
-      .derive = float_counter_get(&res->ru_utime, /* factor = */ 100)};
+  vl.values = &(value_t){.derive = float_counter_get(&res->counters.ru_utime,
+                                                    /* factor = */ 100)};
   sstrncpy(vl.type, "cpu", sizeof(vl.type));
   sstrncpy(vl.type_instance, "user", sizeof(vl.type_instance));
   plugin_dispatch_values(&vl);
 
-  vl.values = &(value_t){
-      .derive = float_counter_get(&res->ru_stime, /* factor = */ 100)};
+  vl.values = &(value_t){.derive = float_counter_get(&res->counters.ru_stime,
+                                                    /* factor = */ 100)};
   sstrncpy(vl.type, "cpu", sizeof(vl.type));
   sstrncpy(vl.type_instance, "system", sizeof(vl.type_instance));
   plugin_dispatch_values(&vl);
 
-  vl.values = &(value_t){.gauge = res->mem_peak};
+  vl.values = &(value_t){.gauge = res->counters.mem_peak};
   sstrncpy(vl.type, "memory", sizeof(vl.type));
   sstrncpy(vl.type_instance, "peak", sizeof(vl.type_instance));
   plugin_dispatch_values(&vl);
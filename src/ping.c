@@ -24,11 +24,15 @@
  *   Florian octo Forster <octo at collectd.org>
  **/
 
+#define _GNU_SOURCE /* For recvmmsg */
+
 #include "collectd.h"
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/heap/heap.h"
 #include "utils_complain.h"
+#include "utils_random.h"
 
 #include <netinet/in.h>
 #if HAVE_NETDB_H
@@ -39,7 +43,26 @@
 #include <sys/capability.h>
 #endif
 
+#if HAVE_LIBOPING
 #include <oping.h>
+#endif
+
+/* The native engine schedules every host on its own and needs Linux' batched
+ * socket calls and receive timestamps. */
+#if KERNEL_LINUX && HAVE_RECVMMSG && HAVE_SENDMMSG
+#define PING_HAVE_NATIVE 1
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <netinet/icmp6.h>
+#include <netinet/ip.h>
+#include <netinet/ip_icmp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#endif
+
+#if !HAVE_LIBOPING && !PING_HAVE_NATIVE
+#error "The ping plugin needs liboping or the native Linux engine."
+#endif
 
 #ifndef NI_MAXHOST
 #define NI_MAXHOST 1025
@@ -49,6 +72,16 @@
 #define HAVE_OPING_1_3
 #endif
 
+#ifndef PING_DEF_AF
+#define PING_DEF_AF AF_UNSPEC
+#endif
+#ifndef PING_DEF_TTL
+#define PING_DEF_TTL 255
+#endif
+
+/* Size of the default payload, which makes an ICMPv4 packet 64 bytes long. */
+#define PING_DEF_DATA_SIZE 56
+
 /*
  * Private data types
  */
@@ -62,18 +95,34 @@ struct hostlist_s {
   double latency_total;
   double latency_squared;
 
+  /* Accumulators of the native engine. They are updated without holding
+   * `ping_lock' and swapped out by ping_read(). `pkg_counts' holds the number
+   * of sent packets in the upper and of received packets in the lower 32 bits,
+   * so that both change atomically. Latencies are in microseconds. */
+  uint64_t pkg_counts;
+  uint64_t latency_total_us;
+  uint64_t latency_squared_us;
+
   struct hostlist_s *next;
 };
 typedef struct hostlist_s hostlist_t;
 
+enum ping_engine_e { PING_ENGINE_LIBOPING, PING_ENGINE_NATIVE };
+
 /*
  * Private variables
  */
 static hostlist_t *hostlist_head;
 
+#if HAVE_LIBOPING
+static enum ping_engine_e ping_engine = PING_ENGINE_LIBOPING;
+#else
+static enum ping_engine_e ping_engine = PING_ENGINE_NATIVE;
+#endif
+
 static int ping_af = PING_DEF_AF;
 static char *ping_source;
-#ifdef HAVE_OPING_1_3
+#if defined(HAVE_OPING_1_3) || PING_HAVE_NATIVE
 static char *ping_device;
 #endif
 static char *ping_data;
@@ -87,18 +136,23 @@ static pthread_cond_t ping_cond = PTHREAD_COND_INITIALIZER;
 static int ping_thread_loop;
 static int ping_thread_error;
 static pthread_t ping_thread_id;
+#if PING_HAVE_NATIVE
+/* Wakes the native engine up when the thread is stopped. */
+static int ping_wake_fd[2] = {-1, -1};
+#endif
 
 static const char *config_keys[] = {"Host",    "SourceAddress", "AddressFamily",
-#ifdef HAVE_OPING_1_3
+#if defined(HAVE_OPING_1_3) || PING_HAVE_NATIVE
                                     "Device",
 #endif
                                     "Size",    "TTL",           "Interval",
-                                    "Timeout", "MaxMissed"};
+                                    "Timeout", "MaxMissed",     "Engine"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 /*
  * Private functions
  */
+#if HAVE_LIBOPING
 /* Assure that `ts->tv_nsec' is in the range 0 .. 999999999 */
 static void time_normalize(struct timespec *ts) /* {{{ */
 {
@@ -345,10 +399,728 @@ static void *ping_thread(void *arg) /* {{{ */
 
   return (void *)0;
 } /* }}} void *ping_thread */
+#endif /* HAVE_LIBOPING */
+
+#if PING_HAVE_NATIVE
+/*
+ * Native engine
+ *
+ * Every host has its own send time, kept in a heap, and at most one
+ * outstanding probe. Probes that became due are sent with one sendmmsg(2)
+ * per address family, replies are read with recvmmsg(2) and carry a receive
+ * timestamp taken by the kernel. Replies are matched to hosts by an
+ * identifier in the payload, so a host that does not answer only affects
+ * its own statistics.
+ */
+#define PING_NATIVE_BATCH 64
+#define PING_NATIVE_MAGIC 0x636f6c64 /* "cold" */
+#define PING_NATIVE_CONTROL_SIZE 256
+/* Hosts that could not be resolved are retried this often. */
+#define PING_NATIVE_RESOLVE_INTERVAL TIME_T_TO_CDTIME_T(60)
+
+/* Stored at the start of the ICMP payload, in network byte order. */
+struct ping_native_payload_s {
+  uint32_t magic;
+  uint32_t target;
+};
+
+typedef struct {
+  hostlist_t *hl;
+
+  struct sockaddr_storage addr;
+  socklen_t addr_len; /* zero while the host could not be resolved */
+  cdtime_t resolve_next;
+  c_complain_t resolve_complaint;
+
+  cdtime_t next_send;
+  cdtime_t deadline;
+  uint64_t send_ns; /* CLOCK_REALTIME */
+  uint16_t seq;
+  bool outstanding;
+  uint32_t missed;
+} ping_target_t;
+
+typedef struct {
+  int fd;
+  int af;
+  /* Raw sockets see all ICMP traffic, so replies are filtered by `ident'.
+   * Datagram ("ping") sockets only see replies to their own requests. */
+  bool raw;
+  uint16_t ident;
+
+  struct mmsghdr msgs[PING_NATIVE_BATCH];
+  struct iovec iov[PING_NATIVE_BATCH];
+  ping_target_t *batch[PING_NATIVE_BATCH];
+  size_t batch_num;
+} ping_socket_t;
+
+/* Probes ordered by their deadline. Since all probes use the same timeout,
+ * this is a plain FIFO. */
+typedef struct {
+  uint32_t target;
+  uint16_t seq;
+} ping_pending_t;
+
+typedef struct {
+  ping_target_t *targets;
+  size_t targets_num;
+  c_heap_t *schedule;
+
+  ping_socket_t sockets[2];
+  size_t sockets_num;
+
+  ping_pending_t *pending;
+  size_t pending_size;
+  size_t pending_head;
+  size_t pending_num;
+
+  uint8_t *tx_buf;
+  uint8_t *rx_buf;
+  char *rx_control;
+  struct sockaddr_storage *rx_addr;
+  size_t packet_size;
+  size_t rx_size;
+  size_t payload_size;
+
+  cdtime_t interval;
+  cdtime_t timeout;
+  c_complain_t complaint;
+} ping_native_t;
+
+static int ping_native_compare(const void *a, const void *b) /* {{{ */
+{
+  const ping_target_t *t0 = a;
+  const ping_target_t *t1 = b;
+
+  return (t0->next_send > t1->next_send) - (t0->next_send < t1->next_send);
+} /* }}} int ping_native_compare */
+
+static uint64_t ping_native_now_ns(void) /* {{{ */
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ((uint64_t)ts.tv_sec) * 1000000000 + (uint64_t)ts.tv_nsec;
+} /* }}} uint64_t ping_native_now_ns */
+
+static uint16_t ping_native_checksum(const uint8_t *buf, size_t len) /* {{{ */
+{
+  uint32_t sum = 0;
+
+  for (size_t i = 0; i + 1 < len; i += 2)
+    sum += (uint32_t)((buf[i] << 8) | buf[i + 1]);
+  if (len % 2)
+    sum += (uint32_t)(buf[len - 1] << 8);
+
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+
+  return htons((uint16_t)~sum);
+} /* }}} uint16_t ping_native_checksum */
+
+static ping_socket_t *ping_native_socket(ping_native_t *pn, int af) /* {{{ */
+{
+  for (size_t i = 0; i < pn->sockets_num; i++)
+    if (pn->sockets[i].af == af)
+      return &pn->sockets[i];
+  return NULL;
+} /* }}} ping_socket_t *ping_native_socket */
+
+static int ping_native_resolve(ping_native_t *pn, /* {{{ */
+                               ping_target_t *t) {
+  struct addrinfo *ai_list;
+  struct addrinfo hints = {
+      .ai_family = ping_af,
+      .ai_flags = AI_ADDRCONFIG,
+      .ai_socktype = SOCK_RAW,
+  };
+
+  t->addr_len = 0;
+  t->resolve_next = cdtime() + PING_NATIVE_RESOLVE_INTERVAL;
+
+  int status = getaddrinfo(t->hl->host, NULL, &hints, &ai_list);
+  if (status != 0) {
+    c_complain(LOG_WARNING, &t->resolve_complaint,
+               "ping plugin: Resolving \"%s\" failed: %s", t->hl->host,
+               (status == EAI_SYSTEM) ? STRERRNO : gai_strerror(status));
+    return -1;
+  }
+
+  for (struct addrinfo *ai = ai_list; ai != NULL; ai = ai->ai_next) {
+    if (ping_native_socket(pn, ai->ai_family) == NULL ||
+        ai->ai_addrlen > sizeof(t->addr))
+      continue;
+
+    memcpy(&t->addr, ai->ai_addr, ai->ai_addrlen);
+    t->addr_len = ai->ai_addrlen;
+    break;
+  }
+  freeaddrinfo(ai_list);
+
+  if (t->addr_len == 0) {
+    c_complain(LOG_WARNING, &t->resolve_complaint,
+               "ping plugin: \"%s\" has no address of a usable family.",
+               t->hl->host);
+    return -1;
+  }
+
+  c_release(LOG_NOTICE, &t->resolve_complaint,
+            "ping plugin: Resolving \"%s\" succeeded.", t->hl->host);
+  return 0;
+} /* }}} int ping_native_resolve */
+
+static int ping_native_bind_source(int fd, int af) /* {{{ */
+{
+  struct addrinfo *ai_list;
+  struct addrinfo hints = {
+      .ai_family = af,
+      .ai_flags = AI_PASSIVE,
+      .ai_socktype = SOCK_RAW,
+  };
+
+  int status = getaddrinfo(ping_source, NULL, &hints, &ai_list);
+  if (status != 0)
+    return -1;
+
+  status = bind(fd, ai_list->ai_addr, ai_list->ai_addrlen);
+  freeaddrinfo(ai_list);
+  return status;
+} /* }}} int ping_native_bind_source */
+
+static int ping_native_open(ping_socket_t *ps, int af) /* {{{ */
+{
+  int proto = (af == AF_INET) ? IPPROTO_ICMP : IPPROTO_ICMPV6;
+
+  memset(ps, 0, sizeof(*ps));
+  ps->af = af;
+
+  /* Prefer unprivileged ping sockets (see net.ipv4.ping_group_range). */
+  ps->fd = socket(af, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, proto);
+  if (ps->fd < 0) {
+    ps->fd = socket(af, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, proto);
+    ps->raw = true;
+  }
+  if (ps->fd < 0)
+    return -1;
+
+  /* Datagram sockets get their identifier from the kernel. */
+  ps->ident = (uint16_t)(cdrand_u() & 0xffff);
+
+  if (ping_source != NULL && ping_native_bind_source(ps->fd, af) != 0) {
+    /* The source address is of the other family. AddressFamily is ignored
+     * when SourceAddress is set, so only use the matching socket. */
+    close(ps->fd);
+    ps->fd = -1;
+    return -1;
+  }
+
+  if (ping_device != NULL &&
+      setsockopt(ps->fd, SOL_SOCKET, SO_BINDTODEVICE, ping_device,
+                 (socklen_t)(strlen(ping_device) + 1)) != 0)
+    ERROR("ping plugin: Binding to device %s failed: %s", ping_device,
+          STRERRNO);
+
+  /* Replies of a whole batch of hosts may arrive at once. */
+  int rcvbuf = 1 << 20;
+  setsockopt(ps->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+  int ttl = ping_ttl;
+  if (af == AF_INET)
+    setsockopt(ps->fd, IPPROTO_IP, IP_TTL, &ttl, sizeof(ttl));
+  else
+    setsockopt(ps->fd, IPPROTO_IPV6, IPV6_UNICAST_HOPS, &ttl, sizeof(ttl));
+
+  if (ps->raw && af == AF_INET6) {
+    struct icmp6_filter filter;
+    ICMP6_FILTER_SETBLOCKALL(&filter);
+    ICMP6_FILTER_SETPASS(ICMP6_ECHO_REPLY, &filter);
+    setsockopt(ps->fd, IPPROTO_ICMPV6, ICMP6_FILTER, &filter, sizeof(filter));
+  }
+
+  /* Receive timestamps; fall back to user space time if neither works. */
+  int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+  if (setsockopt(ps->fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) !=
+      0) {
+    int on = 1;
+    setsockopt(ps->fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+  }
+
+  return 0;
+} /* }}} int ping_native_open */
+
+/* Records the outcome of a probe. `latency_us' is negative if the probe timed
+ * out. */
+static void ping_native_account(ping_native_t *pn, /* {{{ */
+                                ping_target_t *t, int64_t latency_us) {
+  hostlist_t *hl = t->hl;
+
+  t->outstanding = false;
+
+  if (latency_us >= 0) {
+    uint64_t us = (uint64_t)latency_us;
+    __atomic_fetch_add(&hl->latency_total_us, us, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hl->latency_squared_us, us * us, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hl->pkg_counts, (UINT64_C(1) << 32) | 1,
+                       __ATOMIC_RELAXED);
+    t->missed = 0;
+    return;
+  }
+
+  __atomic_fetch_add(&hl->pkg_counts, UINT64_C(1) << 32, __ATOMIC_RELAXED);
+  t->missed++;
+
+  /* if the host did not answer our last N packages, trigger a resolv. */
+  if ((ping_max_missed >= 0) && (t->missed >= ((uint32_t)ping_max_missed)) &&
+      (t->addr_len != 0)) {
+    t->missed = 0;
+    WARNING("ping plugin: host %s has not answered %d PING requests,"
+            " triggering resolve",
+            hl->host, ping_max_missed);
+    ping_native_resolve(pn, t);
+  }
+} /* }}} void ping_native_account */
+
+static void ping_native_expire(ping_native_t *pn, cdtime_t now) /* {{{ */
+{
+  while (pn->pending_num > 0) {
+    ping_pending_t *p = &pn->pending[pn->pending_head];
+    ping_target_t *t = &pn->targets[p->target];
+
+    if (t->outstanding && t->seq == p->seq) {
+      if (t->deadline > now)
+        break;
+      ping_native_account(pn, t, -1);
+    }
+
+    pn->pending_head = (pn->pending_head + 1) % pn->pending_size;
+    pn->pending_num--;
+  }
+} /* }}} void ping_native_expire */
+
+static void ping_native_pending_push(ping_native_t *pn, /* {{{ */
+                                     ping_target_t *t) {
+  /* The queue holds two slots per host, which only fills when sending lags
+   * behind. Give up on the oldest probe in that case. */
+  if (pn->pending_num == pn->pending_size) {
+    ping_pending_t *p = &pn->pending[pn->pending_head];
+    ping_target_t *old = &pn->targets[p->target];
+    if (old->outstanding && old->seq == p->seq)
+      ping_native_account(pn, old, -1);
+    pn->pending_head = (pn->pending_head + 1) % pn->pending_size;
+    pn->pending_num--;
+  }
+
+  size_t tail = (pn->pending_head + pn->pending_num) % pn->pending_size;
+  pn->pending[tail] = (ping_pending_t){
+      .target = (uint32_t)(t - pn->targets),
+      .seq = t->seq,
+  };
+  pn->pending_num++;
+} /* }}} void ping_native_pending_push */
+
+/* Sends the probes collected in `ps->batch'. */
+static void ping_native_flush(ping_native_t *pn, ping_socket_t *ps) /* {{{ */
+{
+  if (ps->batch_num == 0)
+    return;
+
+  size_t offset = (size_t)(ps - pn->sockets) * PING_NATIVE_BATCH;
+  for (size_t i = 0; i < ps->batch_num; i++) {
+    ping_target_t *t = ps->batch[i];
+    uint8_t *pkt = pn->tx_buf + (offset + i) * pn->packet_size;
+
+    memset(pkt, 0, 8);
+    pkt[0] = (ps->af == AF_INET) ? ICMP_ECHO : ICMP6_ECHO_REQUEST;
+    uint16_t ident = htons(ps->ident);
+    uint16_t seq = htons(t->seq);
+    memcpy(pkt + 4, &ident, sizeof(ident));
+    memcpy(pkt + 6, &seq, sizeof(seq));
+
+    struct ping_native_payload_s payload = {
+        .magic = htonl(PING_NATIVE_MAGIC),
+        .target = htonl((uint32_t)(t - pn->targets)),
+    };
+    memcpy(pkt + 8, &payload, sizeof(payload));
+
+    /* The kernel computes ICMPv6 checksums. */
+    if (ps->af == AF_INET) {
+      uint16_t sum = ping_native_checksum(pkt, pn->packet_size);
+      memcpy(pkt + 2, &sum, sizeof(sum));
+    }
+
+    ps->iov[i] = (struct iovec){.iov_base = pkt, .iov_len = pn->packet_size};
+    ps->msgs[i] = (struct mmsghdr){
+        .msg_hdr =
+            {
+                .msg_name = &t->addr,
+                .msg_namelen = t->addr_len,
+                .msg_iov = &ps->iov[i],
+                .msg_iovlen = 1,
+            },
+    };
+  }
+
+  cdtime_t now = cdtime();
+  uint64_t now_ns = ping_native_now_ns();
+  size_t sent = 0;
+  while (sent < ps->batch_num) {
+    int status = sendmmsg(ps->fd, ps->msgs + sent,
+                          (unsigned int)(ps->batch_num - sent), 0);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      /* The first remaining message failed: count it as lost and go on. */
+      c_complain(LOG_ERR, &pn->complaint,
+                 "ping plugin: Sending to %s failed: %s",
+                 ps->batch[sent]->hl->host, STRERRNO);
+      ps->batch[sent]->send_ns = 0;
+      sent++;
+      continue;
+    }
+
+    for (int i = 0; i < status; i++)
+      ps->batch[sent + i]->send_ns = now_ns;
+    sent += (size_t)status;
+  }
+  c_release(LOG_NOTICE, &pn->complaint, "ping plugin: Sending succeeded.");
+
+  for (size_t i = 0; i < ps->batch_num; i++) {
+    ping_target_t *t = ps->batch[i];
+
+    t->outstanding = true;
+    t->deadline = now + pn->timeout;
+    if (t->send_ns == 0)
+      ping_native_account(pn, t, -1);
+    else
+      ping_native_pending_push(pn, t);
+  }
+
+  ps->batch_num = 0;
+} /* }}} void ping_native_flush */
+
+/* Sends probes to all hosts that are due. */
+static void ping_native_send(ping_native_t *pn, cdtime_t now) /* {{{ */
+{
+  ping_target_t *t;
+
+  while ((t = c_heap_peek_root(pn->schedule)) != NULL &&
+         t->next_send <= now) {
+    t = c_heap_get_root(pn->schedule);
+
+    /* Send times advance by exactly one interval so that the hosts stay
+     * spread out; skip slots that have been missed altogether. */
+    t->next_send += pn->interval;
+    if (t->next_send <= now)
+      t->next_send = now + pn->interval;
+
+    if (t->outstanding)
+      ping_native_account(pn, t, -1);
+
+    if (t->addr_len == 0 &&
+        (now < t->resolve_next || ping_native_resolve(pn, t) != 0)) {
+      ping_native_account(pn, t, -1);
+      c_heap_insert(pn->schedule, t);
+      continue;
+    }
+
+    ping_socket_t *ps = ping_native_socket(pn, t->addr.ss_family);
+    t->seq++;
+    ps->batch[ps->batch_num++] = t;
+    if (ps->batch_num == PING_NATIVE_BATCH)
+      ping_native_flush(pn, ps);
+
+    c_heap_insert(pn->schedule, t);
+  }
+
+  for (size_t i = 0; i < pn->sockets_num; i++)
+    ping_native_flush(pn, &pn->sockets[i]);
+} /* }}} void ping_native_send */
+
+static bool ping_native_same_addr(const ping_target_t *t, /* {{{ */
+                                  const struct sockaddr_storage *ss) {
+  if (t->addr.ss_family != ss->ss_family)
+    return false;
+
+  if (ss->ss_family == AF_INET) {
+    const struct sockaddr_in *a = (const struct sockaddr_in *)&t->addr;
+    const struct sockaddr_in *b = (const struct sockaddr_in *)ss;
+    return a->sin_addr.s_addr == b->sin_addr.s_addr;
+  }
+
+  const struct sockaddr_in6 *a = (const struct sockaddr_in6 *)&t->addr;
+  const struct sockaddr_in6 *b = (const struct sockaddr_in6 *)ss;
+  return memcmp(&a->sin6_addr, &b->sin6_addr, sizeof(a->sin6_addr)) == 0;
+} /* }}} bool ping_native_same_addr */
+
+static uint64_t ping_native_rx_time(struct msghdr *mh) /* {{{ */
+{
+  for (struct cmsghdr *cm = CMSG_FIRSTHDR(mh); cm != NULL;
+       cm = CMSG_NXTHDR(mh, cm)) {
+    if (cm->cmsg_level != SOL_SOCKET)
+      continue;
+
+    struct timespec ts;
+    if (cm->cmsg_type == SCM_TIMESTAMPING) {
+      struct scm_timestamping tss;
+      memcpy(&tss, CMSG_DATA(cm), sizeof(tss));
+      ts = tss.ts[0];
+    } else if (cm->cmsg_type == SCM_TIMESTAMPNS) {
+      memcpy(&ts, CMSG_DATA(cm), sizeof(ts));
+    } else {
+      continue;
+    }
+
+    if (ts.tv_sec != 0 || ts.tv_nsec != 0)
+      return ((uint64_t)ts.tv_sec) * 1000000000 + (uint64_t)ts.tv_nsec;
+  }
+
+  return ping_native_now_ns();
+} /* }}} uint64_t ping_native_rx_time */
+
+static void ping_native_handle(ping_native_t *pn, /* {{{ */
+                               ping_socket_t *ps, const uint8_t *buf,
+                               size_t len, struct msghdr *mh) {
+  size_t off = 0;
+
+  /* Raw IPv4 sockets return the IP header, too. */
+  if (ps->raw && ps->af == AF_INET) {
+    if (len < sizeof(struct ip))
+      return;
+    off = (size_t)(buf[0] & 0x0f) * 4;
+  }
+
+  if (len < off + 8 + sizeof(struct ping_native_payload_s))
+    return;
+
+  const uint8_t *icmp = buf + off;
+  if (icmp[0] != ((ps->af == AF_INET) ? ICMP_ECHOREPLY : ICMP6_ECHO_REPLY))
+    return;
+
+  uint16_t ident;
+  uint16_t seq;
+  memcpy(&ident, icmp + 4, sizeof(ident));
+  memcpy(&seq, icmp + 6, sizeof(seq));
+  if (ps->raw && ntohs(ident) != ps->ident)
+    return;
+
+  struct ping_native_payload_s payload;
+  memcpy(&payload, icmp + 8, sizeof(payload));
+  uint32_t idx = ntohl(payload.target);
+  if (ntohl(payload.magic) != PING_NATIVE_MAGIC || idx >= pn->targets_num)
+    return;
+
+  ping_target_t *t = &pn->targets[idx];
+  if (!t->outstanding || t->seq != ntohs(seq) ||
+      !ping_native_same_addr(t, mh->msg_name))
+    return;
+
+  uint64_t rx_ns = ping_native_rx_time(mh);
+  int64_t latency_us = 0;
+  if (rx_ns > t->send_ns)
+    latency_us = (int64_t)((rx_ns - t->send_ns) / 1000);
+
+  ping_native_account(pn, t, latency_us);
+} /* }}} void ping_native_handle */
+
+static void ping_native_receive(ping_native_t *pn, /* {{{ */
+                                ping_socket_t *ps) {
+  struct mmsghdr msgs[PING_NATIVE_BATCH];
+  struct iovec iov[PING_NATIVE_BATCH];
+
+  while (42) {
+    for (size_t i = 0; i < PING_NATIVE_BATCH; i++) {
+      iov[i] = (struct iovec){
+          .iov_base = pn->rx_buf + i * pn->rx_size,
+          .iov_len = pn->rx_size,
+      };
+      msgs[i] = (struct mmsghdr){
+          .msg_hdr =
+              {
+                  .msg_name = &pn->rx_addr[i],
+                  .msg_namelen = sizeof(pn->rx_addr[i]),
+                  .msg_iov = &iov[i],
+                  .msg_iovlen = 1,
+                  .msg_control =
+                      pn->rx_control + i * PING_NATIVE_CONTROL_SIZE,
+                  .msg_controllen = PING_NATIVE_CONTROL_SIZE,
+              },
+      };
+    }
+
+    int status = recvmmsg(ps->fd, msgs, PING_NATIVE_BATCH, MSG_DONTWAIT,
+                          /* timeout = */ NULL);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        c_complain(LOG_ERR, &pn->complaint,
+                   "ping plugin: recvmmsg failed: %s", STRERRNO);
+      return;
+    }
+
+    for (int i = 0; i < status; i++)
+      ping_native_handle(pn, ps, iov[i].iov_base, msgs[i].msg_len,
+                         &msgs[i].msg_hdr);
+
+    if (status < PING_NATIVE_BATCH)
+      return;
+  }
+} /* }}} void ping_native_receive */
+
+static void ping_native_destroy(ping_native_t *pn) /* {{{ */
+{
+  for (size_t i = 0; i < pn->sockets_num; i++)
+    close(pn->sockets[i].fd);
+
+  if (pn->schedule != NULL)
+    c_heap_destroy(pn->schedule);
+
+  sfree(pn->targets);
+  sfree(pn->pending);
+  sfree(pn->tx_buf);
+  sfree(pn->rx_buf);
+  sfree(pn->rx_control);
+  sfree(pn->rx_addr);
+} /* }}} void ping_native_destroy */
+
+static int ping_native_create(ping_native_t *pn) /* {{{ */
+{
+  pn->interval = DOUBLE_TO_CDTIME_T(ping_interval);
+  pn->timeout = DOUBLE_TO_CDTIME_T(ping_timeout);
+  C_COMPLAIN_INIT(&pn->complaint);
+
+  int families[] = {AF_INET, AF_INET6};
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(families); i++) {
+    if (ping_source == NULL && ping_af != AF_UNSPEC && ping_af != families[i])
+      continue;
+    if (ping_native_open(&pn->sockets[pn->sockets_num], families[i]) == 0)
+      pn->sockets_num++;
+  }
+  if (pn->sockets_num == 0) {
+    ERROR("ping plugin: Opening an ICMP socket failed: %s", STRERRNO);
+    return -1;
+  }
+
+  size_t data_size =
+      (ping_data != NULL) ? strlen(ping_data) : PING_DEF_DATA_SIZE;
+  pn->payload_size = (data_size > sizeof(struct ping_native_payload_s))
+                         ? data_size
+                         : sizeof(struct ping_native_payload_s);
+  pn->packet_size = 8 + pn->payload_size;
+  /* Raw IPv4 replies start with an IP header of up to 60 bytes. */
+  pn->rx_size = 60 + pn->packet_size;
+
+  for (hostlist_t *hl = hostlist_head; hl != NULL; hl = hl->next)
+    pn->targets_num++;
+
+  pn->targets = calloc(pn->targets_num, sizeof(*pn->targets));
+  pn->pending_size = 2 * pn->targets_num;
+  pn->pending = calloc(pn->pending_size, sizeof(*pn->pending));
+  pn->tx_buf = calloc(STATIC_ARRAY_SIZE(pn->sockets) * PING_NATIVE_BATCH,
+                      pn->packet_size);
+  pn->rx_buf = calloc(PING_NATIVE_BATCH, pn->rx_size);
+  pn->rx_control = calloc(PING_NATIVE_BATCH, PING_NATIVE_CONTROL_SIZE);
+  pn->rx_addr = calloc(PING_NATIVE_BATCH, sizeof(*pn->rx_addr));
+  pn->schedule = c_heap_create(ping_native_compare);
+  if (pn->targets == NULL || pn->pending == NULL || pn->tx_buf == NULL ||
+      pn->rx_buf == NULL || pn->rx_control == NULL || pn->rx_addr == NULL ||
+      pn->schedule == NULL) {
+    ERROR("ping plugin: ping_native_create: Allocation failed.");
+    return -1;
+  }
+
+  /* The payload after the header is the same for all packets. */
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(pn->sockets) * PING_NATIVE_BATCH;
+       i++) {
+    uint8_t *data = pn->tx_buf + i * pn->packet_size + 8;
+    for (size_t j = sizeof(struct ping_native_payload_s); j < pn->payload_size;
+         j++)
+      data[j] = (ping_data != NULL) ? (uint8_t)ping_data[j]
+                                    : (uint8_t)('0' + j % 64);
+  }
+
+  /* Spread the first probes evenly over one interval. */
+  cdtime_t now = cdtime();
+  size_t i = 0;
+  for (hostlist_t *hl = hostlist_head; hl != NULL; hl = hl->next, i++) {
+    ping_target_t *t = &pn->targets[i];
+
+    t->hl = hl;
+    C_COMPLAIN_INIT(&t->resolve_complaint);
+    t->seq = (uint16_t)(cdrand_u() & 0xffff);
+    t->next_send = now + (pn->interval * i) / pn->targets_num;
+    ping_native_resolve(pn, t);
+    c_heap_insert(pn->schedule, t);
+  }
+
+  return 0;
+} /* }}} int ping_native_create */
+
+static void *ping_native_thread(void *arg) /* {{{ */
+{
+  ping_native_t pn = {0};
+
+  if (ping_native_create(&pn) != 0) {
+    ping_native_destroy(&pn);
+    pthread_mutex_lock(&ping_lock);
+    ping_thread_error = 1;
+    pthread_mutex_unlock(&ping_lock);
+    return (void *)-1;
+  }
+
+  struct pollfd fds[STATIC_ARRAY_SIZE(pn.sockets) + 1];
+  for (size_t i = 0; i < pn.sockets_num; i++)
+    fds[i] = (struct pollfd){.fd = pn.sockets[i].fd, .events = POLLIN};
+  fds[pn.sockets_num] = (struct pollfd){.fd = ping_wake_fd[0], .events = POLLIN};
+
+  pthread_mutex_lock(&ping_lock);
+  while (ping_thread_loop > 0) {
+    pthread_mutex_unlock(&ping_lock);
+
+    cdtime_t now = cdtime();
+    ping_native_expire(&pn, now);
+    ping_native_send(&pn, now);
+
+    /* Sleep until the next host is due or the oldest probe times out. */
+    cdtime_t wakeup = now + pn.interval;
+    ping_target_t *next = c_heap_peek_root(pn.schedule);
+    if (next != NULL && next->next_send < wakeup)
+      wakeup = next->next_send;
+    if (pn.pending_num > 0) {
+      ping_pending_t *p = &pn.pending[pn.pending_head];
+      if (pn.targets[p->target].deadline < wakeup)
+        wakeup = pn.targets[p->target].deadline;
+    }
+
+    now = cdtime();
+    int timeout_ms = 0;
+    if (wakeup > now)
+      timeout_ms = (int)((CDTIME_T_TO_US(wakeup - now) + 999) / 1000);
+
+    int status = poll(fds, pn.sockets_num + 1, timeout_ms);
+    if (status < 0 && errno != EINTR) {
+      ERROR("ping plugin: poll failed: %s", STRERRNO);
+      pthread_mutex_lock(&ping_lock);
+      ping_thread_error = 1;
+      break;
+    }
+
+    for (size_t i = 0; status > 0 && i < pn.sockets_num; i++)
+      if (fds[i].revents & POLLIN)
+        ping_native_receive(&pn, &pn.sockets[i]);
+
+    pthread_mutex_lock(&ping_lock);
+  } /* while (ping_thread_loop > 0) */
+
+  pthread_mutex_unlock(&ping_lock);
+  ping_native_destroy(&pn);
+
+  return (void *)0;
+} /* }}} void *ping_native_thread */
+#endif /* PING_HAVE_NATIVE */
 
 static int start_thread(void) /* {{{ */
 {
-  int status;
+  int status = -1;
 
   pthread_mutex_lock(&ping_lock);
 
@@ -359,8 +1131,23 @@ static int start_thread(void) /* {{{ */
 
   ping_thread_loop = 1;
   ping_thread_error = 0;
-  status = plugin_thread_create(&ping_thread_id, ping_thread,
-                                /* arg = */ (void *)0, "ping");
+#if PING_HAVE_NATIVE
+  if (ping_engine == PING_ENGINE_NATIVE) {
+    if (pipe2(ping_wake_fd, O_NONBLOCK | O_CLOEXEC) != 0) {
+      ping_thread_loop = 0;
+      ERROR("ping plugin: pipe2 failed: %s", STRERRNO);
+      pthread_mutex_unlock(&ping_lock);
+      return -1;
+    }
+    status = plugin_thread_create(&ping_thread_id, ping_native_thread,
+                                  /* arg = */ (void *)0, "ping");
+  }
+#endif
+#if HAVE_LIBOPING
+  if (ping_engine == PING_ENGINE_LIBOPING)
+    status = plugin_thread_create(&ping_thread_id, ping_thread,
+                                  /* arg = */ (void *)0, "ping");
+#endif
   if (status != 0) {
     ping_thread_loop = 0;
     ERROR("ping plugin: Starting thread failed.");
@@ -385,6 +1172,10 @@ static int stop_thread(void) /* {{{ */
 
   ping_thread_loop = 0;
   pthread_cond_broadcast(&ping_cond);
+#if PING_HAVE_NATIVE
+  if (ping_wake_fd[1] >= 0)
+    (void)write(ping_wake_fd[1], "x", 1);
+#endif
   pthread_mutex_unlock(&ping_lock);
 
   status = pthread_join(ping_thread_id, /* return = */ NULL);
@@ -396,6 +1187,13 @@ static int stop_thread(void) /* {{{ */
   pthread_mutex_lock(&ping_lock);
   memset(&ping_thread_id, 0, sizeof(ping_thread_id));
   ping_thread_error = 0;
+#if PING_HAVE_NATIVE
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(ping_wake_fd); i++) {
+    if (ping_wake_fd[i] >= 0)
+      close(ping_wake_fd[i]);
+    ping_wake_fd[i] = -1;
+  }
+#endif
   pthread_mutex_unlock(&ping_lock);
 
   return status;
@@ -473,6 +1271,9 @@ static int ping_config(const char *key, const char *value) /* {{{ */
     hl->pkg_missed = 0;
     hl->latency_total = 0.0;
     hl->latency_squared = 0.0;
+    hl->pkg_counts = 0;
+    hl->latency_total_us = 0;
+    hl->latency_squared_us = 0;
     hl->next = hostlist_head;
     hostlist_head = hl;
   } else if (strcasecmp(key, "AddressFamily") == 0) {
@@ -497,7 +1298,7 @@ static int ping_config(const char *key, const char *value) /* {{{ */
     if (status != 0)
       return status;
   }
-#ifdef HAVE_OPING_1_3
+#if defined(HAVE_OPING_1_3) || PING_HAVE_NATIVE
   else if (strcasecmp(key, "Device") == 0) {
     int status = config_set_string(key, &ping_device, value);
     if (status != 0)
@@ -558,6 +1359,24 @@ static int ping_config(const char *key, const char *value) /* {{{ */
     ping_max_missed = atoi(value);
     if (ping_max_missed < 0)
       INFO("ping plugin: MaxMissed < 0, disabled re-resolving of hosts");
+  } else if (strcasecmp(key, "Engine") == 0) {
+    if (strcasecmp(value, "liboping") == 0) {
+#if HAVE_LIBOPING
+      ping_engine = PING_ENGINE_LIBOPING;
+#else
+      WARNING("ping plugin: The plugin has been built without liboping. "
+              "Using the native engine.");
+#endif
+    } else if (strcasecmp(value, "native") == 0) {
+#if PING_HAVE_NATIVE
+      ping_engine = PING_ENGINE_NATIVE;
+#else
+      WARNING("ping plugin: The native engine is not available on this "
+              "system. Using liboping.");
+#endif
+    } else {
+      WARNING("ping plugin: Ignoring invalid Engine \"%s\".", value);
+    }
   } else {
     return -1;
   }
@@ -590,6 +1409,9 @@ static int ping_read(void) /* {{{ */
       hl->pkg_recv = 0;
       hl->latency_total = 0.0;
       hl->latency_squared = 0.0;
+      hl->pkg_counts = 0;
+      hl->latency_total_us = 0;
+      hl->latency_squared_us = 0;
     }
 
     start_thread();
@@ -609,21 +1431,37 @@ static int ping_read(void) /* {{{ */
 
     double droprate;
 
-    /* Locking here works, because the structure of the linked list is only
-     * changed during configure and shutdown. */
-    pthread_mutex_lock(&ping_lock);
+    if (ping_engine == PING_ENGINE_NATIVE) {
+      uint64_t counts = __atomic_exchange_n(&hl->pkg_counts, 0, __ATOMIC_RELAXED);
+      uint64_t total_us =
+          __atomic_exchange_n(&hl->latency_total_us, 0, __ATOMIC_RELAXED);
+      uint64_t squared_us =
+          __atomic_exchange_n(&hl->latency_squared_us, 0, __ATOMIC_RELAXED);
+
+      pkg_sent = (uint32_t)(counts >> 32);
+      pkg_recv = (uint32_t)counts;
+      /* The latency sums are swapped out separately from the counters. */
+      if (pkg_recv > pkg_sent)
+        pkg_recv = pkg_sent;
+      latency_total = ((double)total_us) / 1000.0;
+      latency_squared = ((double)squared_us) / 1000000.0;
+    } else {
+      /* Locking here works, because the structure of the linked list is only
+       * changed during configure and shutdown. */
+      pthread_mutex_lock(&ping_lock);
 
-    pkg_sent = hl->pkg_sent;
-    pkg_recv = hl->pkg_recv;
-    latency_total = hl->latency_total;
-    latency_squared = hl->latency_squared;
+      pkg_sent = hl->pkg_sent;
+      pkg_recv = hl->pkg_recv;
+      latency_total = hl->latency_total;
+      latency_squared = hl->latency_squared;
 
-    hl->pkg_sent = 0;
-    hl->pkg_recv = 0;
-    hl->latency_total = 0.0;
-    hl->latency_squared = 0.0;
+      hl->pkg_sent = 0;
+      hl->pkg_recv = 0;
+      hl->latency_total = 0.0;
+      hl->latency_squared = 0.0;
 
-    pthread_mutex_unlock(&ping_lock);
+      pthread_mutex_unlock(&ping_lock);
+    }
 
     /* This e. g. happens when starting up. */
     if (pkg_sent == 0) {
@@ -682,6 +1520,10 @@ static int ping_shutdown(void) /* {{{ */
     free(ping_data);
     ping_data = NULL;
   }
+  sfree(ping_source);
+#if defined(HAVE_OPING_1_3) || PING_HAVE_NATIVE
+  sfree(ping_device);
+#endif
 
   return 0;
 } /* }}} int ping_shutdown */
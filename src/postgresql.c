@@ -37,9 +37,13 @@
 #include "plugin.h"
 
 #include "utils/db_query/db_query.h"
+#include "utils/latency/latency.h"
+#include "utils/latency/latency_config.h"
+#include "utils/strbuf/strbuf.h"
 #include "utils_cache.h"
 #include "utils_complain.h"
 
+#include <arpa/inet.h> /* htonl/htons */
 #include <libpq-fe.h>
 #include <pg_config_manual.h>
 
@@ -81,6 +85,9 @@
  * given (host, port) pair. Depending on the value of
  * 'host' a UNIX domain socket or a TCP socket is
  * assumed. */
+#define C_PSQL_PLUGIN(db)                                                      \
+  (((db)->plugin_name != NULL) ? (db)->plugin_name : "postgresql")
+
 #define C_PSQL_SOCKET3(host, port)                                             \
   ((NULL == (host)) || ('\0' == *(host))) ? DEFAULT_PGSOCKET_DIR : host,       \
       C_PSQL_IS_UNIX_DOMAIN_SOCKET(host) ? "/.s.PGSQL." : ":", port
@@ -97,21 +104,94 @@ typedef enum {
 typedef struct {
   c_psql_param_t *params;
   int params_num;
+
+  /* statement timeout of this query; zero to use the database's */
+  cdtime_t timeout;
 } c_psql_user_data_t;
 
+/* Columns filled by a COPY writer, in this order. */
+#define C_PSQL_COPY_COLUMNS                                                    \
+  "time, host, plugin, plugin_instance, type, type_instance, dsname, "        \
+  "dstype, value"
+#define C_PSQL_COPY_COLUMNS_NUM 9
+
+/* Number of seconds between the UNIX and the PostgreSQL epoch
+ * (2000-01-01 00:00:00 UTC). */
+#define C_PSQL_EPOCH_OFFSET 946684800
+
 typedef struct {
   char *name;
   char *statement;
   bool store_rates;
+
+  /* COPY mode: rows are streamed into this table instead of executing
+   * "statement" for each value list. */
+  char *copy_table;
+  size_t copy_batch_size;
+  cdtime_t copy_flush_interval;
 } c_psql_writer_t;
 
+/* Per-database state of a COPY writer. The rows are buffered in the binary
+ * COPY format and sent over a connection of their own, so that they are not
+ * serialized with the statement writers and queries. */
 typedef struct {
+  c_psql_writer_t *writer;
+
   PGconn *conn;
   c_complain_t conn_complaint;
 
+  pthread_mutex_t lock;
+  strbuf_t buffer;
+  size_t rows_num;
+  cdtime_t first_row;
+} c_psql_copy_t;
+
+typedef struct {
+  udb_query_t *query;
+  /* false if the query cannot be prepared, e.g. because it consists of more
+   * than one statement */
+  bool ok;
+} c_psql_prepared_t;
+
+typedef struct {
+  PGconn *pg;
+  c_complain_t complaint;
+
   int proto_version;
   int server_version;
 
+  /* "statement_timeout" of the session in milliseconds; -1 if it has not been
+   * changed from the server's default */
+  int statement_timeout;
+
+  /* queries prepared as "collectd_<index>" in this session */
+  c_psql_prepared_t *prepared;
+  size_t prepared_num;
+
+  /* make sure we don't access the connection in parallel */
+  pthread_mutex_t lock;
+} c_psql_conn_t;
+
+typedef struct {
+  /* connection shared by the writers and, unless "QueryConnections" is set,
+   * the queries */
+  c_psql_conn_t conn;
+
+  /* dedicated connections for the queries; each query is run by a read
+   * callback of its own on one of them */
+  c_psql_conn_t *query_conns;
+  size_t query_conns_num;
+
+  cdtime_t query_timeout;
+  bool prepare_queries;
+
+  /* query durations */
+  bool query_durations;
+  latency_config_t query_latency;
+  latency_counter_t *latency;
+  cdtime_t latency_reset;
+  pthread_mutex_t latency_lock;
+
   int max_params_num;
 
   /* user configuration */
@@ -122,8 +202,8 @@ typedef struct {
   c_psql_writer_t **writers;
   size_t writers_num;
 
-  /* make sure we don't access the database object in parallel */
-  pthread_mutex_t db_lock;
+  c_psql_copy_t **copies;
+  size_t copies_num;
 
   /* writer "caching" settings */
   cdtime_t commit_interval;
@@ -162,8 +242,10 @@ static size_t queries_num;
 static c_psql_writer_t *writers;
 static size_t writers_num;
 
+static void c_psql_copy_destroy(c_psql_database_t *db, c_psql_copy_t *copy);
+
 static int c_psql_begin(c_psql_database_t *db) {
-  PGresult *r = PQexec(db->conn, "BEGIN");
+  PGresult *r = PQexec(db->conn.pg, "BEGIN");
 
   int status = 1;
 
@@ -173,14 +255,14 @@ static int c_psql_begin(c_psql_database_t *db) {
       status = 0;
     } else
       log_warn("Failed to initiate ('BEGIN') transaction: %s",
-               PQerrorMessage(db->conn));
+               PQerrorMessage(db->conn.pg));
     PQclear(r);
   }
   return status;
 } /* c_psql_begin */
 
 static int c_psql_commit(c_psql_database_t *db) {
-  PGresult *r = PQexec(db->conn, "COMMIT");
+  PGresult *r = PQexec(db->conn.pg, "COMMIT");
 
   int status = 1;
 
@@ -190,12 +272,37 @@ static int c_psql_commit(c_psql_database_t *db) {
       log_debug("Successfully committed transaction.");
       status = 0;
     } else
-      log_warn("Failed to commit transaction: %s", PQerrorMessage(db->conn));
+      log_warn("Failed to commit transaction: %s", PQerrorMessage(db->conn.pg));
     PQclear(r);
   }
   return status;
 } /* c_psql_commit */
 
+static void c_psql_conn_init(c_psql_conn_t *c) {
+  c->pg = NULL;
+  C_COMPLAIN_INIT(&c->complaint);
+
+  c->proto_version = 0;
+  c->server_version = 0;
+  c->statement_timeout = -1;
+
+  c->prepared = NULL;
+  c->prepared_num = 0;
+
+  pthread_mutex_init(&c->lock, /* attrs = */ NULL);
+} /* c_psql_conn_init */
+
+static void c_psql_conn_destroy(c_psql_conn_t *c) {
+  pthread_mutex_lock(&c->lock);
+  PQfinish(c->pg);
+  c->pg = NULL;
+  sfree(c->prepared);
+  c->prepared_num = 0;
+  pthread_mutex_unlock(&c->lock);
+
+  pthread_mutex_destroy(&c->lock);
+} /* c_psql_conn_destroy */
+
 static c_psql_database_t *c_psql_database_new(const char *name) {
   c_psql_database_t **tmp;
   c_psql_database_t *db;
@@ -217,12 +324,18 @@ static c_psql_database_t *c_psql_database_new(const char *name) {
   databases[databases_num] = db;
   ++databases_num;
 
-  db->conn = NULL;
+  c_psql_conn_init(&db->conn);
 
-  C_COMPLAIN_INIT(&db->conn_complaint);
+  db->query_conns = NULL;
+  db->query_conns_num = 0;
+  db->query_timeout = 0;
+  db->prepare_queries = true;
 
-  db->proto_version = 0;
-  db->server_version = 0;
+  db->query_durations = false;
+  memset(&db->query_latency, 0, sizeof(db->query_latency));
+  db->latency = NULL;
+  db->latency_reset = 0;
+  pthread_mutex_init(&db->latency_lock, /* attrs = */ NULL);
 
   db->max_params_num = 0;
 
@@ -233,7 +346,8 @@ static c_psql_database_t *c_psql_database_new(const char *name) {
   db->writers = NULL;
   db->writers_num = 0;
 
-  pthread_mutex_init(&db->db_lock, /* attrs = */ NULL);
+  db->copies = NULL;
+  db->copies_num = 0;
 
   db->commit_interval = 0;
   db->next_commit = 0;
@@ -267,15 +381,27 @@ static void c_psql_database_delete(void *data) {
   if (db->ref_cnt > 0)
     return;
 
+  for (size_t i = 0; i < db->copies_num; ++i)
+    c_psql_copy_destroy(db, db->copies[i]);
+  sfree(db->copies);
+  db->copies_num = 0;
+
+  for (size_t i = 0; i < db->query_conns_num; ++i)
+    c_psql_conn_destroy(db->query_conns + i);
+  sfree(db->query_conns);
+  db->query_conns_num = 0;
+
+  latency_counter_destroy(db->latency);
+  db->latency = NULL;
+  latency_config_free(db->query_latency);
+  pthread_mutex_destroy(&db->latency_lock);
+
   /* wait for the lock to be released by the last writer */
-  pthread_mutex_lock(&db->db_lock);
+  pthread_mutex_lock(&db->conn.lock);
 
   if (db->next_commit > 0)
     c_psql_commit(db);
 
-  PQfinish(db->conn);
-  db->conn = NULL;
-
   if (db->q_prep_areas)
     for (size_t i = 0; i < db->queries_num; ++i)
       udb_query_delete_preparation_area(db->q_prep_areas[i]);
@@ -287,9 +413,9 @@ static void c_psql_database_delete(void *data) {
   sfree(db->writers);
   db->writers_num = 0;
 
-  pthread_mutex_unlock(&db->db_lock);
+  pthread_mutex_unlock(&db->conn.lock);
 
-  pthread_mutex_destroy(&db->db_lock);
+  c_psql_conn_destroy(&db->conn);
 
   sfree(db->database);
   sfree(db->host);
@@ -314,16 +440,9 @@ static void c_psql_database_delete(void *data) {
   return;
 } /* c_psql_database_delete */
 
-static int c_psql_connect(c_psql_database_t *db) {
-  char conninfo[4096];
-  char *buf = conninfo;
-  int buf_len = sizeof(conninfo);
-  int status;
-
-  if ((!db) || (!db->database))
-    return -1;
-
-  status = ssnprintf(buf, buf_len, "dbname = '%s'", db->database);
+static void c_psql_conninfo(c_psql_database_t const *db, char *buf,
+                            int buf_len) {
+  int status = ssnprintf(buf, buf_len, "dbname = '%s'", db->database);
   if (0 < status) {
     buf += status;
     buf_len -= status;
@@ -337,83 +456,186 @@ static int c_psql_connect(c_psql_database_t *db) {
   C_PSQL_PAR_APPEND(buf, buf_len, "krbsrvname", db->krbsrvname);
   C_PSQL_PAR_APPEND(buf, buf_len, "service", db->service);
   C_PSQL_PAR_APPEND(buf, buf_len, "application_name", "collectd_postgresql");
+} /* c_psql_conninfo */
 
-  db->conn = PQconnectdb(conninfo);
-  db->proto_version = PQprotocolVersion(db->conn);
+static int c_psql_connect(c_psql_database_t *db, c_psql_conn_t *c) {
+  char conninfo[4096];
+
+  if ((!db) || (!db->database))
+    return -1;
+
+  c_psql_conninfo(db, conninfo, sizeof(conninfo));
+
+  c->pg = PQconnectdb(conninfo);
+  c->proto_version = PQprotocolVersion(c->pg);
+  c->statement_timeout = -1;
+  c->prepared_num = 0;
   return 0;
 } /* c_psql_connect */
 
-static int c_psql_check_connection(c_psql_database_t *db) {
+static int c_psql_check_connection(c_psql_database_t *db,
+                                   c_psql_conn_t *c) {
   bool init = false;
 
-  if (!db->conn) {
+  if (!c->pg) {
     init = true;
 
     /* trigger c_release() */
-    if (0 == db->conn_complaint.interval)
-      db->conn_complaint.interval = 1;
+    if (0 == c->complaint.interval)
+      c->complaint.interval = 1;
 
-    c_psql_connect(db);
+    c_psql_connect(db, c);
   }
 
-  if (CONNECTION_OK != PQstatus(db->conn)) {
-    PQreset(db->conn);
+  if (CONNECTION_OK != PQstatus(c->pg)) {
+    PQreset(c->pg);
 
     /* trigger c_release() */
-    if (0 == db->conn_complaint.interval)
-      db->conn_complaint.interval = 1;
+    if (0 == c->complaint.interval)
+      c->complaint.interval = 1;
 
-    if (CONNECTION_OK != PQstatus(db->conn)) {
-      c_complain(LOG_ERR, &db->conn_complaint,
+    if (CONNECTION_OK != PQstatus(c->pg)) {
+      c_complain(LOG_ERR, &c->complaint,
                  "Failed to connect to database %s (%s): %s", db->database,
-                 db->instance, PQerrorMessage(db->conn));
+                 db->instance, PQerrorMessage(c->pg));
       return -1;
     }
 
-    db->proto_version = PQprotocolVersion(db->conn);
+    c->proto_version = PQprotocolVersion(c->pg);
+    c->statement_timeout = -1;
+    c->prepared_num = 0;
   }
 
-  db->server_version = PQserverVersion(db->conn);
+  c->server_version = PQserverVersion(c->pg);
 
-  if (c_would_release(&db->conn_complaint)) {
+  if (c_would_release(&c->complaint)) {
     char *server_host;
     int server_version;
 
-    server_host = PQhost(db->conn);
-    server_version = PQserverVersion(db->conn);
+    server_host = PQhost(c->pg);
+    server_version = PQserverVersion(c->pg);
 
-    c_do_release(LOG_INFO, &db->conn_complaint,
+    c_do_release(LOG_INFO, &c->complaint,
                  "Successfully %sconnected to database %s (user %s) "
                  "at server %s%s%s (server version: %d.%d.%d, "
                  "protocol version: %d, pid: %d)",
-                 init ? "" : "re", PQdb(db->conn), PQuser(db->conn),
-                 C_PSQL_SOCKET3(server_host, PQport(db->conn)),
-                 C_PSQL_SERVER_VERSION3(server_version), db->proto_version,
-                 PQbackendPID(db->conn));
+                 init ? "" : "re", PQdb(c->pg), PQuser(c->pg),
+                 C_PSQL_SOCKET3(server_host, PQport(c->pg)),
+                 C_PSQL_SERVER_VERSION3(server_version), c->proto_version,
+                 PQbackendPID(c->pg));
 
-    if (3 > db->proto_version)
+    if (3 > c->proto_version)
       log_warn("Protocol version %d does not support parameters.",
-               db->proto_version);
+               c->proto_version);
   }
   return 0;
 } /* c_psql_check_connection */
 
-static PGresult *c_psql_exec_query_noparams(c_psql_database_t *db,
+/* Returns the host name to report values of the database with. */
+static const char *c_psql_host(c_psql_database_t const *db) {
+  if (C_PSQL_IS_UNIX_DOMAIN_SOCKET(db->host) ||
+      (0 == strcmp(db->host, "127.0.0.1")) ||
+      (0 == strcmp(db->host, "localhost")))
+    return hostname_g;
+  return db->host;
+} /* c_psql_host */
+
+/* Sets the "statement_timeout" of the session, unless it already has the
+ * requested value. A timeout of -1 restores the server's default. */
+static int c_psql_set_timeout(c_psql_conn_t *c, int timeout) {
+  char command[64];
+  PGresult *r;
+
+  if (c->statement_timeout == timeout)
+    return 0;
+
+  if (timeout < 0)
+    sstrncpy(command, "RESET statement_timeout", sizeof(command));
+  else
+    ssnprintf(command, sizeof(command), "SET statement_timeout = %d", timeout);
+
+  r = PQexec(c->pg, command);
+  if (PGRES_COMMAND_OK != PQresultStatus(r)) {
+    log_warn("Failed to set the statement timeout (`%s'): %s", command,
+             PQerrorMessage(c->pg));
+    PQclear(r);
+    return -1;
+  }
+  PQclear(r);
+
+  c->statement_timeout = timeout;
+  return 0;
+} /* c_psql_set_timeout */
+
+/* Prepares the query on the connection, unless that has been done (or has
+ * failed) before, and stores the name of the prepared statement in "name".
+ * Returns non-zero if the query has to be executed without preparing it. */
+static int c_psql_prepare(c_psql_conn_t *c, udb_query_t *q, int params_num,
+                          char *name, size_t name_size) {
+  size_t i;
+
+  for (i = 0; i < c->prepared_num; ++i)
+    if (c->prepared[i].query == q)
+      break;
+
+  if (i < c->prepared_num) {
+    if (!c->prepared[i].ok)
+      return -1;
+    ssnprintf(name, name_size, "collectd_%" PRIsz, i);
+    return 0;
+  }
+
+  /* a failing PREPARE would abort the transaction of the writers */
+  if (PQTRANS_IDLE != PQtransactionStatus(c->pg))
+    return -1;
+
+  c_psql_prepared_t *tmp =
+      realloc(c->prepared, (c->prepared_num + 1) * sizeof(*c->prepared));
+  if (tmp == NULL) {
+    log_err("Out of memory.");
+    return -1;
+  }
+  c->prepared = tmp;
+
+  ssnprintf(name, name_size, "collectd_%" PRIsz, i);
+
+  PGresult *r = PQprepare(c->pg, name, udb_query_get_statement(q), params_num,
+                          /* param types = */ NULL);
+  bool ok = (PGRES_COMMAND_OK == PQresultStatus(r));
+  if (!ok)
+    log_info("Failed to prepare query \"%s\", executing it unprepared: %s",
+             udb_query_get_name(q), PQerrorMessage(c->pg));
+  PQclear(r);
+
+  c->prepared[i] = (c_psql_prepared_t){.query = q, .ok = ok};
+  c->prepared_num = i + 1;
+  return ok ? 0 : -1;
+} /* c_psql_prepare */
+
+static PGresult *c_psql_exec_query_noparams(c_psql_conn_t *c,
                                             udb_query_t *q) {
-  return PQexec(db->conn, udb_query_get_statement(q));
+  return PQexec(c->pg, udb_query_get_statement(q));
 } /* c_psql_exec_query_noparams */
 
-static PGresult *c_psql_exec_query_params(c_psql_database_t *db, udb_query_t *q,
+static PGresult *c_psql_exec_query_params(c_psql_database_t *db,
+                                          c_psql_conn_t *c, udb_query_t *q,
                                           c_psql_user_data_t *data) {
   const char *params[db->max_params_num];
   char interval[64];
+  char name[32] = "";
+
+  int params_num = (data != NULL) ? data->params_num : 0;
 
-  if ((data == NULL) || (data->params_num == 0))
-    return c_psql_exec_query_noparams(db, q);
+  if (db->prepare_queries &&
+      (c_psql_prepare(c, q, params_num, name, sizeof(name)) != 0))
+    name[0] = '\0';
 
-  assert(db->max_params_num >= data->params_num);
+  if ((params_num == 0) && (name[0] == '\0'))
+    return c_psql_exec_query_noparams(c, q);
 
-  for (int i = 0; i < data->params_num; ++i) {
+  assert(db->max_params_num >= params_num);
+
+  for (int i = 0; i < params_num; ++i) {
     switch (data->params[i]) {
     case C_PSQL_PARAM_HOST:
       params[i] =
@@ -438,19 +660,22 @@ static PGresult *c_psql_exec_query_params(c_psql_database_t *db, udb_query_t *q,
     }
   }
 
-  return PQexecParams(db->conn, udb_query_get_statement(q), data->params_num,
-                      NULL, (const char *const *)params, NULL, NULL, 0);
+  if (name[0] != '\0')
+    return PQexecPrepared(c->pg, name, params_num,
+                          (const char *const *)params, NULL, NULL, 0);
+
+  return PQexecParams(c->pg, udb_query_get_statement(q), params_num, NULL,
+                      (const char *const *)params, NULL, NULL, 0);
 } /* c_psql_exec_query_params */
 
-/* db->db_lock must be locked when calling this function */
-static int c_psql_exec_query(c_psql_database_t *db, udb_query_t *q,
+/* c->lock must be locked when calling this function */
+static int c_psql_exec_query(c_psql_database_t *db, c_psql_conn_t *c,
+                             udb_query_t *q,
                              udb_query_preparation_area_t *prep_area) {
   PGresult *res;
 
   c_psql_user_data_t *data;
 
-  const char *host;
-
   char **column_names;
   char **column_values;
   int column_num;
@@ -462,15 +687,15 @@ static int c_psql_exec_query(c_psql_database_t *db, udb_query_t *q,
   data = udb_query_get_user_data(q);
 
   /* Versions up to `3' don't know how to handle parameters. */
-  if (3 <= db->proto_version)
-    res = c_psql_exec_query_params(db, q, data);
+  if (3 <= c->proto_version)
+    res = c_psql_exec_query_params(db, c, q, data);
   else if ((NULL == data) || (0 == data->params_num))
-    res = c_psql_exec_query_noparams(db, q);
+    res = c_psql_exec_query_noparams(c, q);
   else {
     log_err("Connection to database \"%s\" (%s) does not support "
             "parameters (protocol version %d) - "
             "cannot execute query \"%s\".",
-            db->database, db->instance, db->proto_version,
+            db->database, db->instance, c->proto_version,
             udb_query_get_name(q));
     return -1;
   }
@@ -478,21 +703,21 @@ static int c_psql_exec_query(c_psql_database_t *db, udb_query_t *q,
   /* give c_psql_write() a chance to acquire the lock if called recursively
    * through dispatch_values(); this will happen if, both, queries and
    * writers are configured for a single connection */
-  pthread_mutex_unlock(&db->db_lock);
+  pthread_mutex_unlock(&c->lock);
 
   column_names = NULL;
   column_values = NULL;
 
   if (PGRES_TUPLES_OK != PQresultStatus(res)) {
-    pthread_mutex_lock(&db->db_lock);
+    pthread_mutex_lock(&c->lock);
 
-    if ((CONNECTION_OK != PQstatus(db->conn)) &&
-        (0 == c_psql_check_connection(db))) {
+    if ((CONNECTION_OK != PQstatus(c->pg)) &&
+        (0 == c_psql_check_connection(db, c))) {
       PQclear(res);
-      return c_psql_exec_query(db, q, prep_area);
+      return c_psql_exec_query(db, c, q, prep_area);
     }
 
-    log_err("Failed to execute SQL query: %s", PQerrorMessage(db->conn));
+    log_err("Failed to execute SQL query: %s", PQerrorMessage(c->pg));
     log_info("SQL query was: %s", udb_query_get_statement(q));
     PQclear(res);
     return -1;
@@ -502,7 +727,7 @@ static int c_psql_exec_query(c_psql_database_t *db, udb_query_t *q,
   sfree(column_names);                                                         \
   sfree(column_values);                                                        \
   PQclear(res);                                                                \
-  pthread_mutex_lock(&db->db_lock);                                            \
+  pthread_mutex_lock(&c->lock);                                            \
   return status
 
   rows_num = PQntuples(res);
@@ -533,17 +758,9 @@ static int c_psql_exec_query(c_psql_database_t *db, udb_query_t *q,
     }
   }
 
-  if (C_PSQL_IS_UNIX_DOMAIN_SOCKET(db->host) ||
-      (0 == strcmp(db->host, "127.0.0.1")) ||
-      (0 == strcmp(db->host, "localhost")))
-    host = hostname_g;
-  else
-    host = db->host;
-
-  status = udb_query_prepare_result(
-      q, prep_area, host,
-      (db->plugin_name != NULL) ? db->plugin_name : "postgresql", db->instance,
-      column_names, (size_t)column_num);
+  status = udb_query_prepare_result(q, prep_area, c_psql_host(db),
+                                    C_PSQL_PLUGIN(db), db->instance,
+                                    column_names, (size_t)column_num);
 
   if (0 != status) {
     log_err("udb_query_prepare_result failed with status %i.", status);
@@ -578,6 +795,116 @@ static int c_psql_exec_query(c_psql_database_t *db, udb_query_t *q,
 #undef BAIL_OUT
 } /* c_psql_exec_query */
 
+static void c_psql_submit_latency(c_psql_database_t *db, cdtime_t now) {
+  latency_config_t *conf = &db->query_latency;
+  value_list_t vl = VALUE_LIST_INIT;
+
+  sstrncpy(vl.host, c_psql_host(db), sizeof(vl.host));
+  sstrncpy(vl.plugin, C_PSQL_PLUGIN(db), sizeof(vl.plugin));
+  sstrncpy(vl.plugin_instance, db->instance, sizeof(vl.plugin_instance));
+  vl.time = now;
+  vl.values_len = 1;
+
+  sstrncpy(vl.type, "latency", sizeof(vl.type));
+  for (size_t i = 0; i < conf->percentile_num; i++) {
+    ssnprintf(vl.type_instance, sizeof(vl.type_instance), "query-%.5g",
+              conf->percentile[i]);
+    vl.values = &(value_t){
+        .gauge = (latency_counter_get_num(db->latency) != 0)
+                     ? CDTIME_T_TO_DOUBLE(latency_counter_get_percentile(
+                           db->latency, conf->percentile[i]))
+                     : NAN,
+    };
+    plugin_dispatch_values(&vl);
+  }
+
+  sstrncpy(vl.type, (conf->bucket_type != NULL) ? conf->bucket_type : "bucket",
+           sizeof(vl.type));
+  for (size_t i = 0; i < conf->buckets_num; i++) {
+    latency_bucket_t bucket = conf->buckets[i];
+
+    double lower_bound = CDTIME_T_TO_DOUBLE(bucket.lower_bound);
+    double upper_bound =
+        bucket.upper_bound ? CDTIME_T_TO_DOUBLE(bucket.upper_bound) : INFINITY;
+
+    ssnprintf(vl.type_instance, sizeof(vl.type_instance), "query-%g_%g",
+              lower_bound, upper_bound);
+    vl.values = &(value_t){
+        .gauge = latency_counter_get_rate(db->latency, bucket.lower_bound,
+                                          bucket.upper_bound, now),
+    };
+    plugin_dispatch_values(&vl);
+  }
+} /* c_psql_submit_latency */
+
+/* Reports how long a query took: as a "duration" value of its own if
+ * "QueryDurations" is enabled, and as part of the distribution of all query
+ * durations ("QueryLatency"), which is submitted once per interval. Must not
+ * be called with a connection lock held, for the values may be written back
+ * to the database. */
+static void c_psql_submit_duration(c_psql_database_t *db, udb_query_t *q,
+                                   cdtime_t duration) {
+  if (db->query_durations) {
+    value_list_t vl = VALUE_LIST_INIT;
+
+    sstrncpy(vl.host, c_psql_host(db), sizeof(vl.host));
+    sstrncpy(vl.plugin, C_PSQL_PLUGIN(db), sizeof(vl.plugin));
+    sstrncpy(vl.plugin_instance, db->instance, sizeof(vl.plugin_instance));
+    sstrncpy(vl.type, "duration", sizeof(vl.type));
+    sstrncpy(vl.type_instance, udb_query_get_name(q),
+             sizeof(vl.type_instance));
+    vl.values = &(value_t){.gauge = CDTIME_T_TO_DOUBLE(duration)};
+    vl.values_len = 1;
+
+    plugin_dispatch_values(&vl);
+  }
+
+  if (db->latency == NULL)
+    return;
+
+  pthread_mutex_lock(&db->latency_lock);
+
+  latency_counter_add(db->latency, duration);
+
+  cdtime_t now = cdtime();
+  if (db->latency_reset == 0)
+    db->latency_reset = now;
+  else if (now - db->latency_reset >= plugin_get_interval()) {
+    c_psql_submit_latency(db, now);
+    latency_counter_reset(db->latency);
+    db->latency_reset = now;
+  }
+
+  pthread_mutex_unlock(&db->latency_lock);
+} /* c_psql_submit_duration */
+
+/* Runs the query with index "idx" on connection "c", which must be locked.
+ * Returns 0 on success, a positive value if the query does not apply to the
+ * server version and a negative value on error. */
+static int c_psql_run_query(c_psql_database_t *db, c_psql_conn_t *c,
+                            size_t idx, cdtime_t *duration) {
+  udb_query_t *q = db->queries[idx];
+  c_psql_user_data_t *data = udb_query_get_user_data(q);
+
+  if ((0 != c->server_version) &&
+      (udb_query_check_version(q, c->server_version) <= 0))
+    return 1;
+
+  cdtime_t timeout = db->query_timeout;
+  if ((data != NULL) && (data->timeout > 0))
+    timeout = data->timeout;
+
+  /* if this fails, the query is still run with the previous timeout */
+  c_psql_set_timeout(c, (timeout > 0) ? (int)CDTIME_T_TO_MS(timeout) : -1);
+
+  cdtime_t start = cdtime();
+  int status = c_psql_exec_query(db, c, q, db->q_prep_areas[idx]);
+  *duration = cdtime() - start;
+
+  return (status == 0) ? 0 : -1;
+} /* c_psql_run_query */
+
+/* Runs all queries of a database, one after another. */
 static int c_psql_read(user_data_t *ud) {
   c_psql_database_t *db;
 
@@ -594,35 +921,80 @@ static int c_psql_read(user_data_t *ud) {
   assert(NULL != db->instance);
   assert(NULL != db->queries);
 
-  pthread_mutex_lock(&db->db_lock);
+  cdtime_t durations[db->queries_num];
+  int status[db->queries_num];
+
+  pthread_mutex_lock(&db->conn.lock);
 
-  if (0 != c_psql_check_connection(db)) {
-    pthread_mutex_unlock(&db->db_lock);
+  if (0 != c_psql_check_connection(db, &db->conn)) {
+    pthread_mutex_unlock(&db->conn.lock);
     return -1;
   }
 
   for (size_t i = 0; i < db->queries_num; ++i) {
-    udb_query_preparation_area_t *prep_area;
-    udb_query_t *q;
-
-    prep_area = db->q_prep_areas[i];
-    q = db->queries[i];
-
-    if ((0 != db->server_version) &&
-        (udb_query_check_version(q, db->server_version) <= 0))
-      continue;
-
-    if (0 == c_psql_exec_query(db, q, prep_area))
+    status[i] = c_psql_run_query(db, &db->conn, i, durations + i);
+    if (0 == status[i])
       success = 1;
   }
 
-  pthread_mutex_unlock(&db->db_lock);
+  /* don't let the statement timeout of the queries apply to the writers */
+  c_psql_set_timeout(&db->conn, -1);
+
+  pthread_mutex_unlock(&db->conn.lock);
+
+  for (size_t i = 0; i < db->queries_num; ++i)
+    if (0 == status[i])
+      c_psql_submit_duration(db, db->queries[i], durations[i]);
 
   if (!success)
     return -1;
   return 0;
 } /* c_psql_read */
 
+/* A single query run by a read callback of its own, see "QueryConnections". */
+typedef struct {
+  c_psql_database_t *db;
+  c_psql_conn_t *conn;
+  size_t query;
+} c_psql_query_task_t;
+
+static void c_psql_query_task_delete(void *data) {
+  c_psql_query_task_t *task = data;
+
+  c_psql_database_delete(task->db);
+  sfree(task);
+} /* c_psql_query_task_delete */
+
+static int c_psql_read_query(user_data_t *ud) {
+  c_psql_query_task_t *task;
+  cdtime_t duration = 0;
+  int status;
+
+  if ((ud == NULL) || (ud->data == NULL)) {
+    log_err("c_psql_read_query: Invalid user data.");
+    return -1;
+  }
+
+  task = ud->data;
+
+  pthread_mutex_lock(&task->conn->lock);
+
+  if (0 != c_psql_check_connection(task->db, task->conn)) {
+    pthread_mutex_unlock(&task->conn->lock);
+    return -1;
+  }
+
+  status = c_psql_run_query(task->db, task->conn, task->query, &duration);
+
+  pthread_mutex_unlock(&task->conn->lock);
+
+  if (status < 0)
+    return -1;
+  if (status == 0)
+    c_psql_submit_duration(task->db, task->db->queries[task->query], duration);
+  return 0;
+} /* c_psql_read_query */
+
 static char *values_name_to_sqlarray(const data_set_t *ds, char *string,
                                      size_t string_len) {
   char *str_ptr;
@@ -771,6 +1143,291 @@ static char *values_to_sqlarray(const data_set_t *ds, const value_list_t *vl,
   return string;
 } /* values_to_sqlarray */
 
+static int c_psql_copy_check_connection(c_psql_database_t *db,
+                                        c_psql_copy_t *copy) {
+  bool init = false;
+
+  if (copy->conn == NULL) {
+    char conninfo[4096];
+
+    init = true;
+
+    /* trigger c_release() */
+    if (0 == copy->conn_complaint.interval)
+      copy->conn_complaint.interval = 1;
+
+    c_psql_conninfo(db, conninfo, sizeof(conninfo));
+    copy->conn = PQconnectdb(conninfo);
+  }
+
+  if (CONNECTION_OK != PQstatus(copy->conn)) {
+    PQreset(copy->conn);
+
+    /* trigger c_release() */
+    if (0 == copy->conn_complaint.interval)
+      copy->conn_complaint.interval = 1;
+
+    if (CONNECTION_OK != PQstatus(copy->conn)) {
+      c_complain(LOG_ERR, &copy->conn_complaint,
+                 "Writer %s: Failed to connect to database %s (%s): %s",
+                 copy->writer->name, db->database, db->instance,
+                 PQerrorMessage(copy->conn));
+      return -1;
+    }
+  }
+
+  /* The binary format of timestamps depends on this setting; servers built
+   * with floating point date-times (the default before 8.4) are not
+   * supported. */
+  const char *datetimes = PQparameterStatus(copy->conn, "integer_datetimes");
+  if ((datetimes != NULL) && (strcmp(datetimes, "on") != 0)) {
+    c_complain(LOG_ERR, &copy->conn_complaint,
+               "Writer %s: Database %s (%s) does not use integer "
+               "date-times, which the COPY writer requires.",
+               copy->writer->name, db->database, db->instance);
+    return -1;
+  }
+
+  if (c_would_release(&copy->conn_complaint))
+    c_do_release(LOG_INFO, &copy->conn_complaint,
+                 "Writer %s: Successfully %sconnected to database %s "
+                 "(user %s, pid: %d)",
+                 copy->writer->name, init ? "" : "re", PQdb(copy->conn),
+                 PQuser(copy->conn), PQbackendPID(copy->conn));
+  return 0;
+} /* c_psql_copy_check_connection */
+
+/* Appends one field in the binary COPY format: its length as a 32 bit
+ * integer, followed by the data. A size of -1 denotes NULL. */
+static int c_psql_copy_put_field(strbuf_t *buf, void const *data,
+                                 int32_t size) {
+  uint32_t len = htonl((uint32_t)size);
+
+  int status = strbuf_printn(buf, (char const *)&len, sizeof(len));
+  if ((status == 0) && (size > 0))
+    status = strbuf_printn(buf, data, (size_t)size);
+  return status;
+} /* c_psql_copy_put_field */
+
+static int c_psql_copy_put_text(strbuf_t *buf, char const *s,
+                                bool empty_is_null) {
+  if (empty_is_null && (s[0] == '\0'))
+    return c_psql_copy_put_field(buf, NULL, -1);
+  return c_psql_copy_put_field(buf, s, (int32_t)strlen(s));
+} /* c_psql_copy_put_text */
+
+static int c_psql_copy_put_row(strbuf_t *buf, value_list_t const *vl,
+                               data_source_t const *dsrc, double value) {
+  uint16_t fields_num = htons(C_PSQL_COPY_COLUMNS_NUM);
+
+  /* timestamptz: microseconds since the PostgreSQL epoch */
+  int64_t us = (int64_t)CDTIME_T_TO_US(vl->time) -
+               (int64_t)C_PSQL_EPOCH_OFFSET * 1000000;
+  uint64_t time = htonll((uint64_t)us);
+
+  /* float8: the IEEE 754 bit pattern in network byte order */
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  bits = htonll(bits);
+
+  int status = strbuf_printn(buf, (char const *)&fields_num, sizeof(fields_num));
+  status = status || c_psql_copy_put_field(buf, &time, sizeof(time));
+  status = status || c_psql_copy_put_text(buf, vl->host, false);
+  status = status || c_psql_copy_put_text(buf, vl->plugin, false);
+  status = status || c_psql_copy_put_text(buf, vl->plugin_instance, true);
+  status = status || c_psql_copy_put_text(buf, vl->type, false);
+  status = status || c_psql_copy_put_text(buf, vl->type_instance, true);
+  status = status || c_psql_copy_put_text(buf, dsrc->name, false);
+  status = status ||
+           c_psql_copy_put_text(buf, DS_TYPE_TO_STRING(dsrc->type), false);
+  status = status || c_psql_copy_put_field(buf, &bits, sizeof(bits));
+  return status ? ENOMEM : 0;
+} /* c_psql_copy_put_row */
+
+/* Runs the COPY command and streams the buffered rows. */
+static int c_psql_copy_send(c_psql_database_t *db, c_psql_copy_t *copy) {
+  /* signature, flags field and length of the header extension area */
+  static char const header[] = "PGCOPY\n\377\r\n\0"
+                               "\0\0\0\0"
+                               "\0\0\0\0";
+  /* file trailer: a field count of -1 */
+  static char const trailer[] = "\377\377";
+
+  char command[1024];
+  PGresult *res;
+  int status = 0;
+
+  if (c_psql_copy_check_connection(db, copy) != 0)
+    return -1;
+
+  ssnprintf(command, sizeof(command),
+            "COPY %s (" C_PSQL_COPY_COLUMNS ") FROM STDIN (FORMAT binary)",
+            copy->writer->copy_table);
+
+  res = PQexec(copy->conn, command);
+  if (PGRES_COPY_IN != PQresultStatus(res)) {
+    log_err("Writer %s: Failed to start COPY: %s", copy->writer->name,
+            PQerrorMessage(copy->conn));
+    log_info("SQL query was: '%s'", command);
+    PQclear(res);
+    return -1;
+  }
+  PQclear(res);
+
+  if ((PQputCopyData(copy->conn, header, sizeof(header) - 1) != 1) ||
+      (PQputCopyData(copy->conn, copy->buffer.ptr, (int)copy->buffer.pos) !=
+       1) ||
+      (PQputCopyData(copy->conn, trailer, sizeof(trailer) - 1) != 1)) {
+    log_err("Writer %s: Failed to send COPY data: %s", copy->writer->name,
+            PQerrorMessage(copy->conn));
+    PQputCopyEnd(copy->conn, "collectd failed to send the data");
+    status = -1;
+  } else if (PQputCopyEnd(copy->conn, NULL) != 1) {
+    log_err("Writer %s: Failed to finish COPY: %s", copy->writer->name,
+            PQerrorMessage(copy->conn));
+    status = -1;
+  }
+
+  while ((res = PQgetResult(copy->conn)) != NULL) {
+    if ((status == 0) && (PGRES_COMMAND_OK != PQresultStatus(res))) {
+      log_err("Writer %s: COPY into %s failed: %s", copy->writer->name,
+              copy->writer->copy_table, PQresultErrorMessage(res));
+      status = -1;
+    }
+    PQclear(res);
+  }
+
+  return status;
+} /* c_psql_copy_send */
+
+/* Sends the buffered rows; copy->lock must be held. Like value lists that a
+ * statement writer failed to insert, the rows are dropped if this fails. */
+static int c_psql_copy_flush(c_psql_database_t *db, c_psql_copy_t *copy) {
+  if (copy->rows_num == 0)
+    return 0;
+
+  int status = c_psql_copy_send(db, copy);
+  if (status != 0)
+    log_warn("Writer %s: Dropping %" PRIsz " rows.", copy->writer->name,
+             copy->rows_num);
+  else
+    log_debug("Writer %s: Copied %" PRIsz " rows.", copy->writer->name,
+              copy->rows_num);
+
+  strbuf_reset(&copy->buffer);
+  copy->rows_num = 0;
+  return status;
+} /* c_psql_copy_flush */
+
+static int c_psql_copy_write(c_psql_database_t *db, c_psql_copy_t *copy,
+                             const data_set_t *ds, const value_list_t *vl) {
+  c_psql_writer_t *writer = copy->writer;
+  gauge_t *rates = NULL;
+  int status = 0;
+
+  if (writer->store_rates) {
+    rates = uc_get_rate(ds, vl);
+    if (rates == NULL) {
+      log_err("c_psql_write: Failed to determine rate");
+      return -1;
+    }
+  }
+
+  pthread_mutex_lock(&copy->lock);
+
+  size_t pos = copy->buffer.pos;
+  for (size_t i = 0; (i < ds->ds_num) && (status == 0); ++i) {
+    double value;
+
+    if (ds->ds[i].type == DS_TYPE_GAUGE)
+      value = vl->values[i].gauge;
+    else if (rates != NULL)
+      value = rates[i];
+    else if (ds->ds[i].type == DS_TYPE_COUNTER)
+      value = (double)vl->values[i].counter;
+    else if (ds->ds[i].type == DS_TYPE_DERIVE)
+      value = (double)vl->values[i].derive;
+    else if (ds->ds[i].type == DS_TYPE_ABSOLUTE)
+      value = (double)vl->values[i].absolute;
+    else {
+      log_err("c_psql_write: Unknown data source type: %i", ds->ds[i].type);
+      status = EINVAL;
+      break;
+    }
+
+    status = c_psql_copy_put_row(&copy->buffer, vl, ds->ds + i, value);
+    if (status != 0)
+      log_err("Writer %s: Out of memory.", writer->name);
+  }
+
+  if (status != 0) {
+    /* don't leave a partial value list behind */
+    strbuf_truncate(&copy->buffer, pos);
+    status = -1;
+  } else {
+    if (copy->rows_num == 0)
+      copy->first_row = cdtime();
+    copy->rows_num += ds->ds_num;
+  }
+
+  if ((copy->rows_num >= writer->copy_batch_size) ||
+      ((copy->rows_num > 0) &&
+       (cdtime() - copy->first_row >= writer->copy_flush_interval))) {
+    if (c_psql_copy_flush(db, copy) != 0)
+      status = -1;
+  }
+
+  pthread_mutex_unlock(&copy->lock);
+
+  sfree(rates);
+  return status;
+} /* c_psql_copy_write */
+
+static int c_psql_copy_add(c_psql_database_t *db, c_psql_writer_t *writer) {
+  c_psql_copy_t **tmp;
+  c_psql_copy_t *copy;
+
+  tmp = realloc(db->copies, (db->copies_num + 1) * sizeof(*db->copies));
+  if (tmp == NULL) {
+    log_err("Out of memory.");
+    return -1;
+  }
+  db->copies = tmp;
+
+  copy = calloc(1, sizeof(*copy));
+  if (copy == NULL) {
+    log_err("Out of memory.");
+    return -1;
+  }
+
+  copy->writer = writer;
+  copy->conn = NULL;
+  C_COMPLAIN_INIT(&copy->conn_complaint);
+  pthread_mutex_init(&copy->lock, /* attrs = */ NULL);
+  copy->buffer = STRBUF_CREATE;
+
+  db->copies[db->copies_num] = copy;
+  ++db->copies_num;
+  return 0;
+} /* c_psql_copy_add */
+
+static void c_psql_copy_destroy(c_psql_database_t *db, c_psql_copy_t *copy) {
+  if (copy == NULL)
+    return;
+
+  pthread_mutex_lock(&copy->lock);
+  c_psql_copy_flush(db, copy);
+
+  PQfinish(copy->conn);
+  copy->conn = NULL;
+
+  STRBUF_DESTROY(copy->buffer);
+  pthread_mutex_unlock(&copy->lock);
+
+  pthread_mutex_destroy(&copy->lock);
+  sfree(copy);
+} /* c_psql_copy_destroy */
+
 static int c_psql_write(const data_set_t *ds, const value_list_t *vl,
                         user_data_t *ud) {
   c_psql_database_t *db;
@@ -791,7 +1448,7 @@ static int c_psql_write(const data_set_t *ds, const value_list_t *vl,
 
   db = ud->data;
   assert(db->database != NULL);
-  assert(db->writers != NULL);
+  assert((db->writers != NULL) || (db->copies != NULL));
 
   if (rfc3339nano_local(time_str, sizeof(time_str), vl->time) != 0) {
     log_err("c_psql_write: Failed to convert time to RFC 3339 format");
@@ -822,10 +1479,17 @@ static int c_psql_write(const data_set_t *ds, const value_list_t *vl,
     return 0;
   }
 
-  pthread_mutex_lock(&db->db_lock);
+  for (size_t i = 0; i < db->copies_num; ++i)
+    if (c_psql_copy_write(db, db->copies[i], ds, vl) == 0)
+      success = 1;
 
-  if (0 != c_psql_check_connection(db)) {
-    pthread_mutex_unlock(&db->db_lock);
+  if (db->writers_num == 0)
+    return success ? 0 : -1;
+
+  pthread_mutex_lock(&db->conn.lock);
+
+  if (0 != c_psql_check_connection(db, &db->conn)) {
+    pthread_mutex_unlock(&db->conn.lock);
     return -1;
   }
 
@@ -840,20 +1504,20 @@ static int c_psql_write(const data_set_t *ds, const value_list_t *vl,
 
     if (values_type_to_sqlarray(ds, values_type_str, sizeof(values_type_str),
                                 writer->store_rates) == NULL) {
-      pthread_mutex_unlock(&db->db_lock);
+      pthread_mutex_unlock(&db->conn.lock);
       return -1;
     }
 
     if (values_to_sqlarray(ds, vl, values_str, sizeof(values_str),
                            writer->store_rates) == NULL) {
-      pthread_mutex_unlock(&db->db_lock);
+      pthread_mutex_unlock(&db->conn.lock);
       return -1;
     }
 
     params[7] = values_type_str;
     params[8] = values_str;
 
-    res = PQexecParams(db->conn, writer->statement, STATIC_ARRAY_SIZE(params),
+    res = PQexecParams(db->conn.pg, writer->statement, STATIC_ARRAY_SIZE(params),
                        NULL, (const char *const *)params, NULL, NULL,
                        /* return text data */ 0);
 
@@ -861,11 +1525,11 @@ static int c_psql_write(const data_set_t *ds, const value_list_t *vl,
         (PGRES_TUPLES_OK != PQresultStatus(res))) {
       PQclear(res);
 
-      if ((CONNECTION_OK != PQstatus(db->conn)) &&
-          (0 == c_psql_check_connection(db))) {
+      if ((CONNECTION_OK != PQstatus(db->conn.pg)) &&
+          (0 == c_psql_check_connection(db, &db->conn))) {
         /* try again */
         res = PQexecParams(
-            db->conn, writer->statement, STATIC_ARRAY_SIZE(params), NULL,
+            db->conn.pg, writer->statement, STATIC_ARRAY_SIZE(params), NULL,
             (const char *const *)params, NULL, NULL, /* return text data */ 0);
 
         if ((PGRES_COMMAND_OK == PQresultStatus(res)) ||
@@ -876,7 +1540,7 @@ static int c_psql_write(const data_set_t *ds, const value_list_t *vl,
         }
       }
 
-      log_err("Failed to execute SQL query: %s", PQerrorMessage(db->conn));
+      log_err("Failed to execute SQL query: %s", PQerrorMessage(db->conn.pg));
       log_info("SQL query was: '%s', "
                "params: %s, %s, %s, %s, %s, %s, %s, %s",
                writer->statement, params[0], params[1], params[2], params[3],
@@ -886,7 +1550,7 @@ static int c_psql_write(const data_set_t *ds, const value_list_t *vl,
       if (db->next_commit > 0)
         c_psql_commit(db);
 
-      pthread_mutex_unlock(&db->db_lock);
+      pthread_mutex_unlock(&db->conn.lock);
       return -1;
     }
 
@@ -897,7 +1561,7 @@ static int c_psql_write(const data_set_t *ds, const value_list_t *vl,
   if ((db->next_commit > 0) && (cdtime() > db->next_commit))
     c_psql_commit(db);
 
-  pthread_mutex_unlock(&db->db_lock);
+  pthread_mutex_unlock(&db->conn.lock);
 
   if (!success)
     return -1;
@@ -906,7 +1570,7 @@ static int c_psql_write(const data_set_t *ds, const value_list_t *vl,
 
 /* We cannot flush single identifiers as all we do is to commit the currently
  * running transaction, thus making sure that all written data is actually
- * visible to everybody. */
+ * visible to everybody, and to send the rows buffered by COPY writers. */
 static int c_psql_flush(cdtime_t timeout,
                         __attribute__((unused)) const char *ident,
                         user_data_t *ud) {
@@ -926,6 +1590,15 @@ static int c_psql_flush(cdtime_t timeout,
      * committed */
     if ((db->next_commit > 0) && (db->commit_interval > timeout))
       c_psql_commit(db);
+
+    for (size_t j = 0; j < db->copies_num; ++j) {
+      c_psql_copy_t *copy = db->copies[j];
+
+      pthread_mutex_lock(&copy->lock);
+      if ((copy->rows_num > 0) && (cdtime() - copy->first_row >= timeout))
+        c_psql_copy_flush(db, copy);
+      pthread_mutex_unlock(&copy->lock);
+    }
   }
   return 0;
 } /* c_psql_flush */
@@ -938,7 +1611,7 @@ static int c_psql_shutdown(void) {
   for (size_t i = 0; i < databases_num; ++i) {
     c_psql_database_t *db = databases[i];
 
-    if (db->writers_num > 0) {
+    if ((db->writers_num > 0) || (db->copies_num > 0)) {
       char cb_name[DATA_MAX_NAME_LEN];
       ssnprintf(cb_name, sizeof(cb_name), "postgresql-%s", db->database);
 
@@ -969,24 +1642,33 @@ static int c_psql_shutdown(void) {
   return 0;
 } /* c_psql_shutdown */
 
-static int config_query_param_add(udb_query_t *q, oconfig_item_t *ci) {
-  c_psql_user_data_t *data;
-  const char *param_str;
+static c_psql_user_data_t *config_query_user_data(udb_query_t *q) {
+  c_psql_user_data_t *data = udb_query_get_user_data(q);
 
-  c_psql_param_t *tmp;
-
-  data = udb_query_get_user_data(q);
   if (data == NULL) {
     data = calloc(1, sizeof(*data));
     if (data == NULL) {
       log_err("Out of memory.");
-      return -1;
+      return NULL;
     }
     data->params = NULL;
     data->params_num = 0;
+    data->timeout = 0;
 
     udb_query_set_user_data(q, data);
   }
+  return data;
+} /* config_query_user_data */
+
+static int config_query_param_add(udb_query_t *q, oconfig_item_t *ci) {
+  c_psql_user_data_t *data;
+  const char *param_str;
+
+  c_psql_param_t *tmp;
+
+  data = config_query_user_data(q);
+  if (data == NULL)
+    return -1;
 
   tmp = realloc(data->params, (data->params_num + 1) * sizeof(*data->params));
   if (tmp == NULL) {
@@ -1018,6 +1700,12 @@ static int config_query_param_add(udb_query_t *q, oconfig_item_t *ci) {
 static int config_query_callback(udb_query_t *q, oconfig_item_t *ci) {
   if (0 == strcasecmp("Param", ci->key))
     return config_query_param_add(q, ci);
+  else if (0 == strcasecmp("Timeout", ci->key)) {
+    c_psql_user_data_t *data = config_query_user_data(q);
+    if (data == NULL)
+      return -1;
+    return cf_util_get_cdtime(ci, &data->timeout);
+  }
 
   log_err("Option not allowed within a Query block: `%s'", ci->key);
 
@@ -1093,6 +1781,9 @@ static int c_psql_config_writer(oconfig_item_t *ci) {
   writer->name = sstrdup(ci->values[0].value.string);
   writer->statement = NULL;
   writer->store_rates = true;
+  writer->copy_table = NULL;
+  writer->copy_batch_size = 1000;
+  writer->copy_flush_interval = TIME_T_TO_CDTIME_T(1);
 
   for (int i = 0; i < ci->children_num; ++i) {
     oconfig_item_t *c = ci->children + i;
@@ -1101,11 +1792,36 @@ static int c_psql_config_writer(oconfig_item_t *ci) {
       status = cf_util_get_string(c, &writer->statement);
     else if (strcasecmp("StoreRates", c->key) == 0)
       status = cf_util_get_boolean(c, &writer->store_rates);
+    else if (strcasecmp("CopyTable", c->key) == 0)
+      status = cf_util_get_string(c, &writer->copy_table);
+    else if (strcasecmp("CopyBatchSize", c->key) == 0) {
+      int batch_size = 0;
+      status = cf_util_get_int(c, &batch_size);
+      if ((status == 0) && (batch_size < 1)) {
+        log_err("Writer %s: \"CopyBatchSize\" must be positive.",
+                writer->name);
+        status = -1;
+      }
+      writer->copy_batch_size = (size_t)batch_size;
+    } else if (strcasecmp("CopyFlushInterval", c->key) == 0)
+      status = cf_util_get_cdtime(c, &writer->copy_flush_interval);
     else
       log_warn("Ignoring unknown config key \"%s\".", c->key);
+
+    if (status != 0)
+      break;
+  }
+
+  if ((status == 0) &&
+      ((writer->statement == NULL) == (writer->copy_table == NULL))) {
+    log_err("Writer %s: Exactly one of \"Statement\" and \"CopyTable\" "
+            "has to be specified.",
+            writer->name);
+    status = -1;
   }
 
   if (status != 0) {
+    sfree(writer->copy_table);
     sfree(writer->statement);
     sfree(writer->name);
     return status;
@@ -1119,6 +1835,7 @@ static int c_psql_config_database(oconfig_item_t *ci) {
   c_psql_database_t *db;
 
   cdtime_t interval = 0;
+  size_t query_conns_num = 0;
   char cb_name[DATA_MAX_NAME_LEN];
   static bool have_flush;
 
@@ -1164,12 +1881,50 @@ static int c_psql_config_database(oconfig_item_t *ci) {
       cf_util_get_cdtime(c, &db->commit_interval);
     else if (strcasecmp("ExpireDelay", c->key) == 0)
       cf_util_get_cdtime(c, &db->expire_delay);
-    else
+    else if (strcasecmp("QueryConnections", c->key) == 0) {
+      int conns_num = 0;
+      if ((cf_util_get_int(c, &conns_num) == 0) && (conns_num >= 0))
+        query_conns_num = (size_t)conns_num;
+      else
+        log_err("\"QueryConnections\" expects a non-negative integer.");
+    } else if (strcasecmp("QueryTimeout", c->key) == 0)
+      cf_util_get_cdtime(c, &db->query_timeout);
+    else if (strcasecmp("PreparedStatements", c->key) == 0)
+      cf_util_get_boolean(c, &db->prepare_queries);
+    else if (strcasecmp("QueryDurations", c->key) == 0)
+      cf_util_get_boolean(c, &db->query_durations);
+    else if (strcasecmp("QueryLatency", c->key) == 0) {
+      latency_config_free(db->query_latency);
+      memset(&db->query_latency, 0, sizeof(db->query_latency));
+      if (latency_config(&db->query_latency, c) != 0) {
+        latency_config_free(db->query_latency);
+        memset(&db->query_latency, 0, sizeof(db->query_latency));
+      }
+    } else
       log_warn("Ignoring unknown config key \"%s\".", c->key);
   }
 
+  /* COPY writers don't share the connection of the statement writers; move
+   * them over to state of their own. */
+  for (size_t i = 0; i < db->writers_num;) {
+    if (db->writers[i]->copy_table == NULL) {
+      ++i;
+      continue;
+    }
+
+    if (c_psql_copy_add(db, db->writers[i]) != 0) {
+      c_psql_database_delete(db);
+      return -1;
+    }
+
+    memmove(db->writers + i, db->writers + i + 1,
+            (db->writers_num - i - 1) * sizeof(*db->writers));
+    --db->writers_num;
+  }
+
   /* If no `Query' options were given, add the default queries.. */
-  if ((db->queries_num == 0) && (db->writers_num == 0)) {
+  if ((db->queries_num == 0) && (db->writers_num == 0) &&
+      (db->copies_num == 0)) {
     for (int i = 0; i < def_queries_num; i++)
       udb_query_pick_from_list_by_name(def_queries[i], queries, queries_num,
                                        &db->queries, &db->queries_num);
@@ -1203,12 +1958,58 @@ static int c_psql_config_database(oconfig_item_t *ci) {
 
   user_data_t ud = {.data = db, .free_func = c_psql_database_delete};
 
-  if (db->queries_num > 0) {
+  if ((db->queries_num > 0) &&
+      ((db->query_latency.percentile_num > 0) ||
+       (db->query_latency.buckets_num > 0))) {
+    db->latency = latency_counter_create();
+    if (db->latency == NULL) {
+      log_err("Out of memory.");
+      c_psql_database_delete(db);
+      return -1;
+    }
+  }
+
+  if ((db->queries_num > 0) && (query_conns_num > 0)) {
+    if (query_conns_num > db->queries_num)
+      query_conns_num = db->queries_num;
+
+    db->query_conns = calloc(query_conns_num, sizeof(*db->query_conns));
+    if (db->query_conns == NULL) {
+      log_err("Out of memory.");
+      c_psql_database_delete(db);
+      return -1;
+    }
+    for (size_t i = 0; i < query_conns_num; ++i)
+      c_psql_conn_init(db->query_conns + i);
+    db->query_conns_num = query_conns_num;
+
+    /* one read callback per query, so that the read threads run them in
+     * parallel; the queries are spread over the connections round-robin */
+    for (size_t i = 0; i < db->queries_num; ++i) {
+      c_psql_query_task_t *task = calloc(1, sizeof(*task));
+      if (task == NULL) {
+        log_err("Out of memory.");
+        break;
+      }
+      task->db = db;
+      task->conn = db->query_conns + (i % db->query_conns_num);
+      task->query = i;
+
+      char task_name[DATA_MAX_NAME_LEN];
+      ssnprintf(task_name, sizeof(task_name), "%s-%s", cb_name,
+                udb_query_get_name(db->queries[i]));
+
+      ++db->ref_cnt;
+      plugin_register_complex_read(
+          "postgresql", task_name, c_psql_read_query, interval,
+          &(user_data_t){.data = task, .free_func = c_psql_query_task_delete});
+    }
+  } else if (db->queries_num > 0) {
     ++db->ref_cnt;
     plugin_register_complex_read("postgresql", cb_name, c_psql_read, interval,
                                  &ud);
   }
-  if (db->writers_num > 0) {
+  if ((db->writers_num > 0) || (db->copies_num > 0)) {
     ++db->ref_cnt;
     plugin_register_write(cb_name, c_psql_write, &ud);
 
@@ -99,6 +99,11 @@
 #ifndef CONFIG_HZ
 #define CONFIG_HZ 100
 #endif
+#include "utils/avltree/avltree.h"
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#include <sys/socket.h>
 /* #endif KERNEL_LINUX */
 
 #elif HAVE_LIBKVM_GETPROCS &&                                                  \
@@ -207,6 +212,9 @@ typedef struct process_entry_s {
   derive_t cswitch_invol;
   bool has_cswitch;
 
+  /* start time in clock ticks after boot (Linux only) */
+  unsigned long long start_time;
+
 #if HAVE_LIBTASKSTATS
   ts_delay_t delay;
 #endif
@@ -314,7 +322,80 @@ static mach_msg_type_number_t pset_list_len;
 
 #elif KERNEL_LINUX
 static long pagesize_g;
+static int ps_proc_fd = -1;
 static void ps_fill_details(const procstat_t *ps, process_entry_t *entry);
+#if HAVE_LIBTASKSTATS
+static void ps_fill_delay(const procstat_t *ps, process_entry_t *entry);
+#endif
+
+/* With "ProcessTracking Netlink", the set of processes is maintained from
+ * the kernel's process events connector and only processes matching one of
+ * the selectors are read from /proc. */
+typedef struct {
+  long pid;
+  /* gen is updated from ps_tasks_gen for each event concerning the process.
+   * The process has to be classified (again) if checked_gen differs from
+   * gen. */
+  uint64_t gen;
+  uint64_t checked_gen;
+  bool matched;
+  bool need_delay;
+} ps_task_t;
+
+static bool ps_track_netlink;
+static c_avl_tree_t *ps_tasks;
+static bool ps_tasks_resync;
+static uint64_t ps_tasks_gen;
+static pthread_mutex_t ps_tasks_lock = PTHREAD_MUTEX_INITIALIZER;
+static int ps_nl_sock = -1;
+static pthread_t ps_nl_thread;
+static bool ps_nl_thread_running;
+
+static int ps_tracking_init(void);
+static int ps_read_tracked(void);
+
+/* The /proc/<pid> directories are divided among "ScanThreads" scanners by
+ * pid. Each scanner is the only user of its cmdline cache, so no locking is
+ * needed while scanning. Scanner zero runs in the read thread. */
+typedef struct {
+  process_entry_t entry;
+  char const *cmdline;
+} ps_result_t;
+
+typedef struct {
+  pthread_t thread;
+  size_t index;
+
+  /* pid -> ps_cmdline_t */
+  c_avl_tree_t *cmdlines;
+
+  int running;
+  int sleeping;
+  int zombies;
+  int stopped;
+  int paging;
+  int blocked;
+
+  /* processes matching at least one selector */
+  ps_result_t *results;
+  size_t results_num;
+  size_t results_size;
+} ps_scanner_t;
+
+static size_t ps_scanners_num = 1;
+static ps_scanner_t *ps_scanners;
+static long *ps_scan_pids;
+static size_t ps_scan_pids_num;
+static size_t ps_scan_pids_size;
+static uint64_t ps_scan_gen;
+static size_t ps_scan_pending;
+static bool ps_scan_shutdown;
+static pthread_mutex_t ps_scan_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ps_scan_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t ps_scan_done_cond = PTHREAD_COND_INITIALIZER;
+
+static int ps_scanners_init(void);
+static int ps_scan(void);
 /* #endif KERNEL_LINUX */
 
 #elif HAVE_LIBKVM_GETPROCS &&                                                  \
@@ -529,6 +610,9 @@ static void ps_list_add(const char *name, const char *cmdline,
 
 #if KERNEL_LINUX
     ps_fill_details(ps, entry);
+#if HAVE_LIBTASKSTATS
+    ps_fill_delay(ps, entry);
+#endif
 #endif
 
     for (pse = ps->instances; pse != NULL; pse = pse->next)
@@ -733,6 +817,37 @@ static int ps_config(oconfig_item_t *ci) {
 #else
       WARNING("processes plugin: The plugin has been compiled without support "
               "for the \"CollectDelayAccounting\" option.");
+#endif
+    } else if (strcasecmp(c->key, "ScanThreads") == 0) {
+#if KERNEL_LINUX
+      int tmp = 0;
+      if (cf_util_get_int(c, &tmp) != 0)
+        continue;
+      if (tmp < 1) {
+        ERROR("processes plugin: `ScanThreads' must be at least 1.");
+        continue;
+      }
+      ps_scanners_num = (size_t)tmp;
+#else
+      WARNING("processes plugin: The \"ScanThreads\" option is only "
+              "available on Linux.");
+#endif
+    } else if (strcasecmp(c->key, "ProcessTracking") == 0) {
+#if KERNEL_LINUX
+      char mode[16];
+      if (cf_util_get_string_buffer(c, mode, sizeof(mode)) != 0)
+        continue;
+      if (strcasecmp(mode, "Scan") == 0)
+        ps_track_netlink = false;
+      else if (strcasecmp(mode, "Netlink") == 0)
+        ps_track_netlink = true;
+      else
+        ERROR("processes plugin: Invalid `ProcessTracking' mode \"%s\". "
+              "Valid modes are \"Scan\" and \"Netlink\".",
+              mode);
+#else
+      WARNING("processes plugin: The \"ProcessTracking\" option is only "
+              "available on Linux.");
 #endif
     } else {
       ERROR("processes plugin: The `%s' configuration option is not "
@@ -780,6 +895,22 @@ static int ps_init(void) {
     }
   }
 #endif
+
+  if (ps_proc_fd == -1) {
+    ps_proc_fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (ps_proc_fd == -1) {
+      ERROR("processes plugin: Cannot open `/proc': %s", STRERRNO);
+      return -1;
+    }
+  }
+
+  if (ps_scanners_init() != 0)
+    return -1;
+
+  if (ps_track_netlink && (ps_nl_sock == -1) && (ps_tracking_init() != 0)) {
+    WARNING("processes plugin: Tracking processes using netlink failed. "
+            "Falling back to scanning /proc.");
+  }
   /* #endif KERNEL_LINUX */
 
 #elif HAVE_LIBKVM_GETPROCS &&                                                  \
@@ -990,22 +1121,81 @@ static void ps_submit_fork_rate(derive_t value) {
 
 /* ------- additional functions for KERNEL_LINUX/HAVE_THREAD_INFO ------- */
 #if KERNEL_LINUX
+/* ps_read_file_at reads the file "path", relative to the directory "dir_fd",
+ * into "buffer" with a single pread(2) call. The buffer is null-terminated.
+ * Returns the number of bytes read or -1 on error. */
+static ssize_t ps_read_file_at(int dir_fd, char const *path, char *buffer,
+                               size_t buffer_size) {
+  ssize_t status;
+
+  int fd = openat(dir_fd, path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+
+  do {
+    status = pread(fd, buffer, buffer_size - 1, /* offset = */ 0);
+  } while ((status < 0) && (errno == EINTR));
+  close(fd);
+
+  if (status < 0)
+    return -1;
+
+  buffer[status] = '\0';
+  return status;
+} /* ssize_t ps_read_file_at */
+
+/* ps_read_pid_file reads "/proc/<pid>/<file>" relative to ps_proc_fd. */
+static ssize_t ps_read_pid_file(long pid, char const *file, char *buffer,
+                                size_t buffer_size) {
+  char path[64];
+
+  snprintf(path, sizeof(path), "%li/%s", pid, file);
+  return ps_read_file_at(ps_proc_fd, path, buffer, buffer_size);
+} /* ssize_t ps_read_pid_file */
+
+/* ps_next_line null-terminates the line starting at "*ptr" and advances
+ * "*ptr" to the next line. Returns NULL when the end of the buffer has been
+ * reached. */
+static char *ps_next_line(char **ptr) {
+  char *line = *ptr;
+
+  if ((line == NULL) || (line[0] == '\0'))
+    return NULL;
+
+  char *end = strchr(line, '\n');
+  if (end != NULL) {
+    *end = '\0';
+    *ptr = end + 1;
+  } else {
+    *ptr = NULL;
+  }
+
+  return line;
+} /* char *ps_next_line */
+
 static int ps_read_tasks_status(process_entry_t *ps) {
   char dirname[64];
   DIR *dh;
   char filename[64];
-  FILE *fh;
   struct dirent *ent;
   derive_t cswitch_vol = 0;
   derive_t cswitch_invol = 0;
-  char buffer[1024];
+  char buffer[4096];
   char *fields[8];
   int numfields;
 
-  snprintf(dirname, sizeof(dirname), "/proc/%li/task", ps->id);
+  snprintf(dirname, sizeof(dirname), "%lu/task", ps->id);
 
-  if ((dh = opendir(dirname)) == NULL) {
-    DEBUG("Failed to open directory `%s'", dirname);
+  int dir_fd =
+      openat(ps_proc_fd, dirname, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd < 0) {
+    DEBUG("Failed to open directory `/proc/%s'", dirname);
+    return -1;
+  }
+
+  if ((dh = fdopendir(dir_fd)) == NULL) {
+    DEBUG("Failed to open directory `/proc/%s'", dirname);
+    close(dir_fd);
     return -1;
   }
 
@@ -1017,27 +1207,32 @@ static int ps_read_tasks_status(process_entry_t *ps) {
 
     tpid = ent->d_name;
 
-    int r = snprintf(filename, sizeof(filename), "/proc/%li/task/%s/status",
-                     ps->id, tpid);
+    int r = snprintf(filename, sizeof(filename), "%s/status", tpid);
     if ((size_t)r >= sizeof(filename)) {
       DEBUG("Filename too long: `%s'", filename);
       continue;
     }
 
-    if ((fh = fopen(filename, "r")) == NULL) {
-      DEBUG("Failed to open file `%s'", filename);
+    if (ps_read_file_at(dirfd(dh), filename, buffer, sizeof(buffer)) <= 0) {
+      DEBUG("Failed to read file `/proc/%s/%s'", dirname, filename);
       continue;
     }
 
-    while (fgets(buffer, sizeof(buffer), fh) != NULL) {
+    char *ptr = buffer;
+    char *line;
+    while ((line = ps_next_line(&ptr)) != NULL) {
       derive_t tmp;
       char *endptr;
+      bool vol;
 
-      if (strncmp(buffer, "voluntary_ctxt_switches", 23) != 0 &&
-          strncmp(buffer, "nonvoluntary_ctxt_switches", 26) != 0)
+      if (strncmp(line, "voluntary_ctxt_switches", 23) == 0)
+        vol = true;
+      else if (strncmp(line, "nonvoluntary_ctxt_switches", 26) == 0)
+        vol = false;
+      else
         continue;
 
-      numfields = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
+      numfields = strsplit(line, fields, STATIC_ARRAY_SIZE(fields));
 
       if (numfields < 2)
         continue;
@@ -1046,17 +1241,12 @@ static int ps_read_tasks_status(process_entry_t *ps) {
       endptr = NULL;
       tmp = (derive_t)strtoll(fields[1], &endptr, /* base = */ 10);
       if ((errno == 0) && (endptr != fields[1])) {
-        if (strncmp(buffer, "voluntary_ctxt_switches", 23) == 0) {
+        if (vol)
           cswitch_vol += tmp;
-        } else if (strncmp(buffer, "nonvoluntary_ctxt_switches", 26) == 0) {
+        else
           cswitch_invol += tmp;
-        }
       }
-    } /* while (fgets) */
-
-    if (fclose(fh)) {
-      WARNING("processes: fclose: %s", STRERRNO);
-    }
+    } /* while (ps_next_line) */
   }
   closedir(dh);
 
@@ -1068,9 +1258,7 @@ static int ps_read_tasks_status(process_entry_t *ps) {
 
 /* Read data from /proc/pid/status */
 static int ps_read_status(long pid, process_entry_t *ps) {
-  FILE *fh;
-  char buffer[1024];
-  char filename[64];
+  char buffer[4096];
   unsigned long lib = 0;
   unsigned long exe = 0;
   unsigned long data = 0;
@@ -1078,18 +1266,19 @@ static int ps_read_status(long pid, process_entry_t *ps) {
   char *fields[8];
   int numfields;
 
-  snprintf(filename, sizeof(filename), "/proc/%li/status", pid);
-  if ((fh = fopen(filename, "r")) == NULL)
+  if (ps_read_pid_file(pid, "status", buffer, sizeof(buffer)) <= 0)
     return -1;
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
+  char *ptr = buffer;
+  char *line;
+  while ((line = ps_next_line(&ptr)) != NULL) {
     unsigned long tmp;
     char *endptr;
 
-    if (strncmp(buffer, "Vm", 2) != 0 && strncmp(buffer, "Threads", 7) != 0)
+    if (strncmp(line, "Vm", 2) != 0 && strncmp(line, "Threads", 7) != 0)
       continue;
 
-    numfields = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
+    numfields = strsplit(line, fields, STATIC_ARRAY_SIZE(fields));
 
     if (numfields < 2)
       continue;
@@ -1098,21 +1287,17 @@ static int ps_read_status(long pid, process_entry_t *ps) {
     endptr = NULL;
     tmp = strtoul(fields[1], &endptr, /* base = */ 10);
     if ((errno == 0) && (endptr != fields[1])) {
-      if (strncmp(buffer, "VmData", 6) == 0) {
+      if (strncmp(line, "VmData", 6) == 0) {
         data = tmp;
-      } else if (strncmp(buffer, "VmLib", 5) == 0) {
+      } else if (strncmp(line, "VmLib", 5) == 0) {
         lib = tmp;
-      } else if (strncmp(buffer, "VmExe", 5) == 0) {
+      } else if (strncmp(line, "VmExe", 5) == 0) {
         exe = tmp;
-      } else if (strncmp(buffer, "Threads", 7) == 0) {
+      } else if (strncmp(line, "Threads", 7) == 0) {
         threads = tmp;
       }
     }
-  } /* while (fgets) */
-
-  if (fclose(fh)) {
-    WARNING("processes: fclose: %s", STRERRNO);
-  }
+  } /* while (ps_next_line) */
 
   ps->vmem_data = data * 1024;
   ps->vmem_code = (exe + lib) * 1024;
@@ -1123,40 +1308,39 @@ static int ps_read_status(long pid, process_entry_t *ps) {
 } /* int *ps_read_status */
 
 static int ps_read_io(process_entry_t *ps) {
-  FILE *fh;
   char buffer[1024];
-  char filename[64];
 
   char *fields[8];
   int numfields;
 
-  snprintf(filename, sizeof(filename), "/proc/%li/io", ps->id);
-  if ((fh = fopen(filename, "r")) == NULL) {
-    DEBUG("ps_read_io: Failed to open file `%s'", filename);
+  if (ps_read_pid_file((long)ps->id, "io", buffer, sizeof(buffer)) <= 0) {
+    DEBUG("ps_read_io: Failed to read file `/proc/%lu/io'", ps->id);
     return -1;
   }
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
+  char *ptr = buffer;
+  char *line;
+  while ((line = ps_next_line(&ptr)) != NULL) {
     derive_t *val = NULL;
     long long tmp;
     char *endptr;
 
-    if (strncasecmp(buffer, "rchar:", 6) == 0)
+    if (strncasecmp(line, "rchar:", 6) == 0)
       val = &(ps->io_rchar);
-    else if (strncasecmp(buffer, "wchar:", 6) == 0)
+    else if (strncasecmp(line, "wchar:", 6) == 0)
       val = &(ps->io_wchar);
-    else if (strncasecmp(buffer, "syscr:", 6) == 0)
+    else if (strncasecmp(line, "syscr:", 6) == 0)
       val = &(ps->io_syscr);
-    else if (strncasecmp(buffer, "syscw:", 6) == 0)
+    else if (strncasecmp(line, "syscw:", 6) == 0)
       val = &(ps->io_syscw);
-    else if (strncasecmp(buffer, "read_bytes:", 11) == 0)
+    else if (strncasecmp(line, "read_bytes:", 11) == 0)
       val = &(ps->io_diskr);
-    else if (strncasecmp(buffer, "write_bytes:", 12) == 0)
+    else if (strncasecmp(line, "write_bytes:", 12) == 0)
       val = &(ps->io_diskw);
     else
       continue;
 
-    numfields = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
+    numfields = strsplit(line, fields, STATIC_ARRAY_SIZE(fields));
 
     if (numfields < 2)
       continue;
@@ -1168,35 +1352,43 @@ static int ps_read_io(process_entry_t *ps) {
       *val = -1;
     else
       *val = (derive_t)tmp;
-  } /* while (fgets) */
+  } /* while (ps_next_line) */
 
-  if (fclose(fh)) {
-    WARNING("processes: fclose: %s", STRERRNO);
-  }
   return 0;
 } /* int ps_read_io (...) */
 
 static int ps_count_maps(pid_t pid) {
-  FILE *fh;
-  char buffer[1024];
+  char buffer[4096];
   char filename[64];
   int count = 0;
 
-  snprintf(filename, sizeof(filename), "/proc/%d/maps", pid);
-  if ((fh = fopen(filename, "r")) == NULL) {
-    DEBUG("ps_count_maps: Failed to open file `%s'", filename);
+  /* The maps file may be much larger than the buffer, so it is read
+   * sequentially rather than with a single pread(2). */
+  snprintf(filename, sizeof(filename), "%d/maps", pid);
+  int fd = openat(ps_proc_fd, filename, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    DEBUG("ps_count_maps: Failed to open file `/proc/%s'", filename);
     return -1;
   }
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
-    if (strchr(buffer, '\n')) {
-      count++;
+  while (42) {
+    ssize_t status = read(fd, buffer, sizeof(buffer));
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      DEBUG("ps_count_maps: Failed to read file `/proc/%s'", filename);
+      break;
+    } else if (status == 0) {
+      break;
     }
-  } /* while (fgets) */
 
-  if (fclose(fh)) {
-    WARNING("processes: fclose: %s", STRERRNO);
+    for (char *ptr = buffer;
+         (ptr = memchr(ptr, '\n', (size_t)(buffer + status - ptr))) != NULL;
+         ptr++)
+      count++;
   }
+
+  close(fd);
   return count;
 } /* int ps_count_maps (...) */
 
@@ -1206,10 +1398,18 @@ static int ps_count_fd(int pid) {
   struct dirent *ent;
   int count = 0;
 
-  snprintf(dirname, sizeof(dirname), "/proc/%i/fd", pid);
+  snprintf(dirname, sizeof(dirname), "%i/fd", pid);
 
-  if ((dh = opendir(dirname)) == NULL) {
-    DEBUG("Failed to open directory `%s'", dirname);
+  int dir_fd =
+      openat(ps_proc_fd, dirname, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd < 0) {
+    DEBUG("Failed to open directory `/proc/%s'", dirname);
+    return -1;
+  }
+
+  if ((dh = fdopendir(dir_fd)) == NULL) {
+    DEBUG("Failed to open directory `/proc/%s'", dirname);
+    close(dir_fd);
     return -1;
   }
   while ((ent = readdir(dh)) != NULL) {
@@ -1224,12 +1424,8 @@ static int ps_count_fd(int pid) {
 } /* int ps_count_fd (pid) */
 
 #if HAVE_LIBTASKSTATS
-static int ps_delay(process_entry_t *ps) {
-  if (taskstats_handle == NULL) {
-    return ENOTCONN;
-  }
-
-  int status = ts_delay_by_tgid(taskstats_handle, (uint32_t)ps->id, &ps->delay);
+/* ps_delay_error reports a failure to read Delay Accounting metrics. */
+static void ps_delay_error(int status) {
   if (status == EPERM) {
     static c_complain_t c;
 #if defined(HAVE_SYS_CAPABILITY_H) && defined(CAP_NET_ADMIN)
@@ -1264,14 +1460,65 @@ static int ps_delay(process_entry_t *ps) {
                "Reading Delay Accounting metrics requires root privileges.",
                STRERROR(status));
 #endif
-    return status;
   } else if (status != 0) {
     ERROR("processes plugin: ts_delay_by_tgid failed: %s", STRERROR(status));
+  }
+}
+
+static int ps_delay(process_entry_t *ps) {
+  if (taskstats_handle == NULL) {
+    return ENOTCONN;
+  }
+
+  int status = ts_delay_by_tgid(taskstats_handle, (uint32_t)ps->id, &ps->delay);
+  if (status != 0) {
+    ps_delay_error(status);
     return status;
   }
 
   return 0;
 }
+
+/* ps_delay_batch reads Delay Accounting metrics for "num" processes using
+ * batched taskstats requests. */
+static void ps_delay_batch(process_entry_t **entries, size_t num) {
+  if ((taskstats_handle == NULL) || (num == 0))
+    return;
+
+  uint32_t *tgids = calloc(num, sizeof(*tgids));
+  ts_delay_t *delays = calloc(num, sizeof(*delays));
+  int *status = calloc(num, sizeof(*status));
+  if ((tgids == NULL) || (delays == NULL) || (status == NULL)) {
+    ERROR("processes plugin: ps_delay_batch: calloc failed.");
+    sfree(tgids);
+    sfree(delays);
+    sfree(status);
+    return;
+  }
+
+  for (size_t i = 0; i < num; i++)
+    tgids[i] = (uint32_t)entries[i]->id;
+
+  int err = ts_delay_by_tgids(taskstats_handle, tgids, num, delays, status);
+  if (err != 0)
+    ps_delay_error(err);
+
+  bool reported = (err != 0);
+  for (size_t i = 0; i < num; i++) {
+    if (status[i] == 0) {
+      entries[i]->delay = delays[i];
+      entries[i]->has_delay = true;
+    } else if ((status[i] != ESRCH) && !reported) {
+      /* ESRCH means the process exited in the meantime. */
+      ps_delay_error(status[i]);
+      reported = true;
+    }
+  }
+
+  sfree(tgids);
+  sfree(delays);
+  sfree(status);
+}
 #endif
 
 static void ps_fill_details(const procstat_t *ps, process_entry_t *entry) {
@@ -1302,19 +1549,22 @@ static void ps_fill_details(const procstat_t *ps, process_entry_t *entry) {
     }
     entry->has_fd = true;
   }
+} /* void ps_fill_details (...) */
 
 #if HAVE_LIBTASKSTATS
+/* ps_fill_delay is separate from ps_fill_details, because the taskstats
+ * handle must not be used by several scanner threads concurrently. */
+static void ps_fill_delay(const procstat_t *ps, process_entry_t *entry) {
   if (ps->report_delay && !entry->has_delay) {
     if (ps_delay(entry) == 0) {
       entry->has_delay = true;
     }
   }
+} /* void ps_fill_delay */
 #endif
-} /* void ps_fill_details (...) */
 
 /* ps_read_process reads process counters on Linux. */
 static int ps_read_process(long pid, process_entry_t *ps, char *state) {
-  char filename[64];
   char buffer[1024];
 
   char *fields[64];
@@ -1335,9 +1585,7 @@ static int ps_read_process(long pid, process_entry_t *ps, char *state) {
 
   ssize_t status;
 
-  snprintf(filename, sizeof(filename), "/proc/%li/stat", pid);
-
-  status = read_text_file_contents(filename, buffer, sizeof(buffer));
+  status = ps_read_pid_file(pid, "stat", buffer, sizeof(buffer));
   if (status <= 0)
     return -1;
   buffer_len = (size_t)status;
@@ -1377,12 +1625,13 @@ static int ps_read_process(long pid, process_entry_t *ps, char *state) {
   fields_len = strsplit(buffer_ptr, fields, STATIC_ARRAY_SIZE(fields));
   if (fields_len < 22) {
     DEBUG("processes plugin: ps_read_process (pid = %li):"
-          " `%s' has only %i fields..",
-          pid, filename, fields_len);
+          " `/proc/%li/stat' has only %i fields..",
+          pid, pid, fields_len);
     return -1;
   }
 
   *state = fields[0][0];
+  ps->start_time = strtoull(fields[19], /* endptr = */ NULL, /* base = */ 10);
 
   if (*state == 'Z') {
     ps->num_lwp = 0;
@@ -1449,9 +1698,10 @@ static int ps_read_process(long pid, process_entry_t *ps, char *state) {
   return 0;
 } /* int ps_read_process (...) */
 
-static int procs_running(void) {
+/* procs_count reads one of the "procs_*" counters from /proc/stat. "id" is
+ * the name of the counter followed by a space, e.g. "procs_running ". */
+static int procs_count(char const *id) {
   char buffer[65536] = {};
-  char id[] = "procs_running "; /* white space terminated */
   char *running;
   char *endptr = NULL;
   long result = 0L;
@@ -1464,14 +1714,14 @@ static int procs_running(void) {
   }
 
   /* the data contains :
-   * the literal string 'procs_running',
+   * the literal string 'procs_running' (or 'procs_blocked'),
    * a whitespace
-   * the number of running processes.
+   * the number of running (blocked) processes.
    * The parser does include the white-space character.
    */
   running = strstr(buffer, id);
   if (!running) {
-    WARNING("procs_running not found");
+    WARNING("%snot found", id);
     return -1;
   }
   running += strlen(id);
@@ -1496,15 +1746,16 @@ static char *ps_get_cmdline(long pid, char *name, char *buf, size_t buf_len) {
   if ((pid < 1) || (NULL == buf) || (buf_len < 2))
     return NULL;
 
-  snprintf(file, sizeof(file), "/proc/%li/cmdline", pid);
+  snprintf(file, sizeof(file), "%li/cmdline", pid);
 
   errno = 0;
-  fd = open(file, O_RDONLY);
+  fd = openat(ps_proc_fd, file, O_RDONLY | O_CLOEXEC);
   if (fd < 0) {
     /* ENOENT means the process exited while we were handling it.
      * Don't complain about this, it only fills the logs. */
     if (errno != ENOENT)
-      WARNING("processes plugin: Failed to open `%s': %s.", file, STRERRNO);
+      WARNING("processes plugin: Failed to open `/proc/%s': %s.", file,
+              STRERRNO);
     return NULL;
   }
 
@@ -1523,7 +1774,7 @@ static char *ps_get_cmdline(long pid, char *name, char *buf, size_t buf_len) {
       if ((EAGAIN == errno) || (EINTR == errno))
         continue;
 
-      WARNING("processes plugin: Failed to read from `%s': %s.", file,
+      WARNING("processes plugin: Failed to read from `/proc/%s': %s.", file,
               STRERRNO);
       close(fd);
       return NULL;
@@ -1612,6 +1863,831 @@ static int read_fork_rate(void) {
   ps_submit_fork_rate(value.derive);
   return 0;
 }
+
+/* Cached command line of a process. The command line is read twice, so that
+ * changes made right after start-up, e.g. by setproctitle(3), are picked up,
+ * and then reused as long as the process' start time doesn't change. */
+typedef struct {
+  long pid;
+  unsigned long long start_time;
+  uint64_t gen;
+  bool confirmed;
+  char *cmdline;
+} ps_cmdline_t;
+
+static int ps_cmdline_compare(const void *a, const void *b) {
+  long pid_a = *((const long *)a);
+  long pid_b = *((const long *)b);
+
+  return (pid_a > pid_b) - (pid_a < pid_b);
+}
+
+static void ps_cmdline_free(ps_cmdline_t *c) {
+  if (c == NULL)
+    return;
+
+  sfree(c->cmdline);
+  sfree(c);
+}
+
+static char const *ps_cmdline_get(ps_scanner_t *s, process_entry_t *pse) {
+  long pid = (long)pse->id;
+  ps_cmdline_t *c = NULL;
+
+  if (c_avl_get(s->cmdlines, &pid, (void *)&c) == 0) {
+    c->gen = ps_scan_gen;
+    if (c->start_time == pse->start_time) {
+      if (c->confirmed)
+        return c->cmdline;
+      c->confirmed = (c->cmdline != NULL);
+    } else {
+      c->start_time = pse->start_time;
+      c->confirmed = false;
+    }
+  } else {
+    c = calloc(1, sizeof(*c));
+    if (c == NULL)
+      return NULL;
+    c->pid = pid;
+    c->start_time = pse->start_time;
+    c->gen = ps_scan_gen;
+
+    if (c_avl_insert(s->cmdlines, &c->pid, c) != 0) {
+      sfree(c);
+      return NULL;
+    }
+  }
+
+  char buffer[CMDLINE_BUFFER_SIZE];
+  char *cmdline = ps_get_cmdline(pid, pse->name, buffer, sizeof(buffer));
+
+  sfree(c->cmdline);
+  c->cmdline = (cmdline != NULL) ? strdup(cmdline) : NULL;
+  if (c->cmdline == NULL)
+    c->confirmed = false;
+
+  return c->cmdline;
+} /* char const *ps_cmdline_get */
+
+/* ps_cmdline_prune removes the cache entries of processes that have not been
+ * seen in the current scan. */
+static void ps_cmdline_prune(ps_scanner_t *s) {
+  long *stale = NULL;
+  size_t stale_num = 0;
+  size_t stale_size = 0;
+
+  c_avl_iterator_t *iter = c_avl_get_iterator(s->cmdlines);
+  void *key = NULL;
+  ps_cmdline_t *c = NULL;
+  while ((iter != NULL) &&
+         (c_avl_iterator_next(iter, &key, (void *)&c) == 0)) {
+    if (c->gen == ps_scan_gen)
+      continue;
+
+    if (stale_num >= stale_size) {
+      size_t new_size = (stale_size == 0) ? 64 : 2 * stale_size;
+      long *tmp = realloc(stale, new_size * sizeof(*stale));
+      if (tmp == NULL)
+        break;
+      stale = tmp;
+      stale_size = new_size;
+    }
+    stale[stale_num++] = c->pid;
+  }
+  c_avl_iterator_destroy(iter);
+
+  for (size_t i = 0; i < stale_num; i++) {
+    if (c_avl_remove(s->cmdlines, &stale[i], &key, (void *)&c) == 0)
+      ps_cmdline_free(c);
+  }
+  sfree(stale);
+} /* void ps_cmdline_prune */
+
+static void ps_scan_one(ps_scanner_t *s, long pid, bool need_cmdline) {
+  process_entry_t pse = {.id = (unsigned long)pid};
+  char state;
+
+  int status = ps_read_process(pid, &pse, &state);
+  if (status != 0) {
+    DEBUG("ps_read_process failed: %i", status);
+    return;
+  }
+
+  switch (state) {
+  case 'R':
+    s->running++;
+    break;
+  case 'S':
+    s->sleeping++;
+    break;
+  case 'D':
+    s->blocked++;
+    break;
+  case 'Z':
+    s->zombies++;
+    break;
+  case 'T':
+    s->stopped++;
+    break;
+  case 'W':
+    s->paging++;
+    break;
+  }
+
+  if (list_head_g == NULL)
+    return;
+
+  char const *cmdline = need_cmdline ? ps_cmdline_get(s, &pse) : NULL;
+
+  bool matched = false;
+  for (procstat_t *ps = list_head_g; ps != NULL; ps = ps->next) {
+    if (ps_list_match(pse.name, cmdline, ps) == 0)
+      continue;
+
+    ps_fill_details(ps, &pse);
+    matched = true;
+  }
+  if (!matched)
+    return;
+
+  if (s->results_num >= s->results_size) {
+    size_t new_size = (s->results_size == 0) ? 16 : 2 * s->results_size;
+    ps_result_t *tmp = realloc(s->results, new_size * sizeof(*s->results));
+    if (tmp == NULL) {
+      ERROR("processes plugin: ps_scan_one: realloc failed.");
+      return;
+    }
+    s->results = tmp;
+    s->results_size = new_size;
+  }
+
+  s->results[s->results_num++] = (ps_result_t){
+      .entry = pse,
+      .cmdline = cmdline,
+  };
+} /* void ps_scan_one */
+
+/* ps_scanner_run reads all processes in ps_scan_pids assigned to scanner
+ * "s". */
+static void ps_scanner_run(ps_scanner_t *s) {
+  bool need_cmdline = false;
+
+#if HAVE_REGEX_H
+  /* The command line is only used for matching regular expressions. */
+  for (procstat_t *ps = list_head_g; ps != NULL; ps = ps->next)
+    if (ps->re != NULL)
+      need_cmdline = true;
+#endif
+
+  s->running = s->sleeping = s->zombies = 0;
+  s->stopped = s->paging = s->blocked = 0;
+  s->results_num = 0;
+
+  for (size_t i = 0; i < ps_scan_pids_num; i++) {
+    long pid = ps_scan_pids[i];
+
+    if (((size_t)pid % ps_scanners_num) != s->index)
+      continue;
+
+    ps_scan_one(s, pid, need_cmdline);
+  }
+
+  ps_cmdline_prune(s);
+} /* void ps_scanner_run */
+
+static void *ps_scanner_thread(void *arg) /* {{{ */
+{
+  ps_scanner_t *s = arg;
+  uint64_t gen = 0;
+
+  pthread_mutex_lock(&ps_scan_lock);
+  while (42) {
+    while (!ps_scan_shutdown && (ps_scan_gen == gen))
+      pthread_cond_wait(&ps_scan_cond, &ps_scan_lock);
+
+    if (ps_scan_shutdown)
+      break;
+
+    gen = ps_scan_gen;
+    pthread_mutex_unlock(&ps_scan_lock);
+
+    ps_scanner_run(s);
+
+    pthread_mutex_lock(&ps_scan_lock);
+    ps_scan_pending--;
+    if (ps_scan_pending == 0)
+      pthread_cond_signal(&ps_scan_done_cond);
+  }
+  pthread_mutex_unlock(&ps_scan_lock);
+
+  return (void *)0;
+} /* }}} void *ps_scanner_thread */
+
+static int ps_scanners_init(void) /* {{{ */
+{
+  if (ps_scanners != NULL)
+    return 0;
+
+  ps_scanners = calloc(ps_scanners_num, sizeof(*ps_scanners));
+  if (ps_scanners == NULL) {
+    ERROR("processes plugin: ps_scanners_init: calloc failed.");
+    return -1;
+  }
+
+  for (size_t i = 0; i < ps_scanners_num; i++) {
+    ps_scanner_t *s = ps_scanners + i;
+
+    s->index = i;
+    s->cmdlines = c_avl_create(ps_cmdline_compare);
+    if (s->cmdlines == NULL) {
+      ERROR("processes plugin: ps_scanners_init: c_avl_create failed.");
+      for (size_t j = 0; j < i; j++)
+        c_avl_destroy(ps_scanners[j].cmdlines);
+      sfree(ps_scanners);
+      return -1;
+    }
+  }
+
+  for (size_t i = 1; i < ps_scanners_num; i++) {
+    int status = plugin_thread_create(&ps_scanners[i].thread,
+                                      ps_scanner_thread, ps_scanners + i,
+                                      "processes scan");
+    if (status != 0) {
+      ERROR("processes plugin: Starting scanner thread failed: %s",
+            STRERROR(status));
+      /* Only the threads that have been started take part in scans. */
+      ps_scanners_num = i;
+      break;
+    }
+  }
+
+  return 0;
+} /* }}} int ps_scanners_init */
+
+static void ps_scanners_destroy(void) {
+  if (ps_scanners == NULL)
+    return;
+
+  pthread_mutex_lock(&ps_scan_lock);
+  ps_scan_shutdown = true;
+  pthread_cond_broadcast(&ps_scan_cond);
+  pthread_mutex_unlock(&ps_scan_lock);
+
+  for (size_t i = 0; i < ps_scanners_num; i++) {
+    ps_scanner_t *s = ps_scanners + i;
+
+    if (i > 0)
+      pthread_join(s->thread, /* retval = */ NULL);
+
+    if (s->cmdlines != NULL) {
+      void *key = NULL;
+      ps_cmdline_t *c = NULL;
+
+      while (c_avl_pick(s->cmdlines, &key, (void *)&c) == 0)
+        ps_cmdline_free(c);
+      c_avl_destroy(s->cmdlines);
+    }
+    sfree(s->results);
+  }
+
+  sfree(ps_scanners);
+  sfree(ps_scan_pids);
+  ps_scan_pids_num = ps_scan_pids_size = 0;
+} /* void ps_scanners_destroy */
+
+/* ps_scan lists /proc and has the scanners read all processes. */
+static int ps_scan(void) /* {{{ */
+{
+  struct dirent *ent;
+  DIR *proc;
+
+  if (ps_scanners == NULL)
+    return -1;
+
+  int dir_fd = openat(ps_proc_fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if ((dir_fd < 0) || ((proc = fdopendir(dir_fd)) == NULL)) {
+    ERROR("Cannot open `/proc': %s", STRERRNO);
+    if (dir_fd >= 0)
+      close(dir_fd);
+    return -1;
+  }
+
+  ps_scan_pids_num = 0;
+  while ((ent = readdir(proc)) != NULL) {
+    long pid;
+
+    if (!isdigit(ent->d_name[0]))
+      continue;
+
+    if ((pid = atol(ent->d_name)) < 1)
+      continue;
+
+    if (ps_scan_pids_num >= ps_scan_pids_size) {
+      size_t new_size =
+          (ps_scan_pids_size == 0) ? 1024 : 2 * ps_scan_pids_size;
+      long *tmp = realloc(ps_scan_pids, new_size * sizeof(*ps_scan_pids));
+      if (tmp == NULL) {
+        ERROR("processes plugin: ps_scan: realloc failed.");
+        break;
+      }
+      ps_scan_pids = tmp;
+      ps_scan_pids_size = new_size;
+    }
+    ps_scan_pids[ps_scan_pids_num++] = pid;
+  }
+
+  closedir(proc);
+
+  pthread_mutex_lock(&ps_scan_lock);
+  ps_scan_gen++;
+  ps_scan_pending = ps_scanners_num - 1;
+  pthread_cond_broadcast(&ps_scan_cond);
+  pthread_mutex_unlock(&ps_scan_lock);
+
+  ps_scanner_run(ps_scanners);
+
+  pthread_mutex_lock(&ps_scan_lock);
+  while (ps_scan_pending > 0)
+    pthread_cond_wait(&ps_scan_done_cond, &ps_scan_lock);
+  pthread_mutex_unlock(&ps_scan_lock);
+
+  return 0;
+} /* }}} int ps_scan */
+
+static int ps_task_compare(const void *a, const void *b) {
+  long pid_a = *((const long *)a);
+  long pid_b = *((const long *)b);
+
+  return (pid_a > pid_b) - (pid_a < pid_b);
+}
+
+/* ps_task_touch records an event for "pid". Must be called with
+ * ps_tasks_lock held. */
+static void ps_task_touch(long pid) {
+  ps_task_t *task = NULL;
+
+  if (c_avl_get(ps_tasks, &pid, (void *)&task) == 0) {
+    task->gen = ++ps_tasks_gen;
+    return;
+  }
+
+  task = calloc(1, sizeof(*task));
+  if (task == NULL) {
+    ERROR("processes plugin: ps_task_touch: calloc failed.");
+    return;
+  }
+  task->pid = pid;
+  task->gen = ++ps_tasks_gen;
+
+  if (c_avl_insert(ps_tasks, &task->pid, task) != 0) {
+    ERROR("processes plugin: ps_task_touch: c_avl_insert failed.");
+    sfree(task);
+  }
+}
+
+/* ps_task_forget removes "pid" from the set of tracked processes. Must be
+ * called with ps_tasks_lock held. */
+static void ps_task_forget(long pid) {
+  void *key = NULL;
+  ps_task_t *task = NULL;
+
+  if (c_avl_remove(ps_tasks, &pid, &key, (void *)&task) == 0)
+    sfree(task);
+}
+
+/* ps_tasks_scan (re-)populates the set of tracked processes from /proc. Must
+ * be called with ps_tasks_lock held. */
+static int ps_tasks_scan(void) {
+  void *key = NULL;
+  ps_task_t *task = NULL;
+
+  while (c_avl_pick(ps_tasks, &key, (void *)&task) == 0)
+    sfree(task);
+
+  DIR *proc = opendir("/proc");
+  if (proc == NULL) {
+    ERROR("processes plugin: Cannot open `/proc': %s", STRERRNO);
+    return -1;
+  }
+
+  struct dirent *ent;
+  while ((ent = readdir(proc)) != NULL) {
+    long pid;
+
+    if (!isdigit(ent->d_name[0]))
+      continue;
+
+    if ((pid = atol(ent->d_name)) < 1)
+      continue;
+
+    ps_task_touch(pid);
+  }
+
+  closedir(proc);
+  return 0;
+}
+
+/* ps_task_classify checks whether process "pid" matches any of the selectors.
+ * Returns zero on success and -1 if the process is gone. */
+static int ps_task_classify(long pid, bool *ret_matched, bool *ret_delay) {
+  char filename[64];
+  char name[PROCSTAT_NAME_LEN];
+  char cmdline[CMDLINE_BUFFER_SIZE];
+  char *cmdline_ptr = NULL;
+  bool have_cmdline = false;
+
+  snprintf(filename, sizeof(filename), "/proc/%li/comm", pid);
+  if (read_text_file_contents(filename, name, sizeof(name)) <= 0)
+    return -1;
+  strstripnewline(name);
+
+  *ret_matched = false;
+  *ret_delay = false;
+
+  for (procstat_t *ps = list_head_g; ps != NULL; ps = ps->next) {
+#if HAVE_REGEX_H
+    if ((ps->re != NULL) && !have_cmdline) {
+      cmdline_ptr = ps_get_cmdline(pid, name, cmdline, sizeof(cmdline));
+      have_cmdline = true;
+    }
+#endif
+
+    if (ps_list_match(name, cmdline_ptr, ps) == 0)
+      continue;
+
+    *ret_matched = true;
+    if (ps->report_delay)
+      *ret_delay = true;
+  }
+
+  return 0;
+}
+
+/* ps_netlink_handle updates the set of tracked processes from a single
+ * process event. Only events concerning whole processes, i.e. thread group
+ * leaders, are of interest. */
+static void ps_netlink_handle(struct proc_event const *ev) {
+  pthread_mutex_lock(&ps_tasks_lock);
+
+  switch (ev->what) {
+  case PROC_EVENT_FORK:
+    if (ev->event_data.fork.child_pid == ev->event_data.fork.child_tgid)
+      ps_task_touch(ev->event_data.fork.child_tgid);
+    break;
+  case PROC_EVENT_EXEC:
+    ps_task_touch(ev->event_data.exec.process_tgid);
+    break;
+  case PROC_EVENT_COMM:
+    ps_task_touch(ev->event_data.comm.process_tgid);
+    break;
+  case PROC_EVENT_EXIT:
+    if (ev->event_data.exit.process_pid == ev->event_data.exit.process_tgid)
+      ps_task_forget(ev->event_data.exit.process_tgid);
+    break;
+  default:
+    break;
+  }
+
+  pthread_mutex_unlock(&ps_tasks_lock);
+}
+
+static void *ps_netlink_thread(void *arg) /* {{{ */
+{
+  struct __attribute__((aligned(NLMSG_ALIGNTO))) {
+    struct nlmsghdr nl_hdr;
+    struct __attribute__((__packed__)) {
+      struct cn_msg cn_msg;
+      struct proc_event proc_ev;
+    };
+  } nlcn_msg;
+
+  /* The thread is only canceled while blocked in recv(2), never while holding
+   * ps_tasks_lock. */
+  pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, /* oldstate = */ NULL);
+
+  while (42) {
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, /* oldstate = */ NULL);
+    ssize_t status = recv(ps_nl_sock, &nlcn_msg, sizeof(nlcn_msg), 0);
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, /* oldstate = */ NULL);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+
+      if (errno == ENOBUFS) {
+        /* The kernel dropped events; rebuild the set from /proc. */
+        pthread_mutex_lock(&ps_tasks_lock);
+        ps_tasks_resync = true;
+        pthread_mutex_unlock(&ps_tasks_lock);
+        continue;
+      }
+
+      ERROR("processes plugin: Receiving process events failed: %s",
+            STRERRNO);
+      break;
+    } else if ((size_t)status < sizeof(nlcn_msg.nl_hdr) +
+                                    sizeof(nlcn_msg.cn_msg) +
+                                    offsetof(struct proc_event, event_data)) {
+      continue;
+    }
+
+    if (nlcn_msg.nl_hdr.nlmsg_type != NLMSG_DONE)
+      continue;
+
+    struct proc_event ev;
+    memcpy(&ev, &nlcn_msg.proc_ev, sizeof(ev));
+    ps_netlink_handle(&ev);
+  }
+
+  /* Have the read callback fall back to scanning /proc. */
+  pthread_mutex_lock(&ps_tasks_lock);
+  close(ps_nl_sock);
+  ps_nl_sock = -1;
+  pthread_mutex_unlock(&ps_tasks_lock);
+
+  return (void *)0;
+} /* }}} void *ps_netlink_thread */
+
+static int ps_netlink_listen(int sock, bool enable) {
+  struct __attribute__((aligned(NLMSG_ALIGNTO))) {
+    struct nlmsghdr nl_hdr;
+    struct __attribute__((__packed__)) {
+      struct cn_msg cn_msg;
+      enum proc_cn_mcast_op cn_mcast;
+    };
+  } nlcn_msg;
+
+  memset(&nlcn_msg, 0, sizeof(nlcn_msg));
+  nlcn_msg.nl_hdr.nlmsg_len = sizeof(nlcn_msg);
+  nlcn_msg.nl_hdr.nlmsg_type = NLMSG_DONE;
+
+  nlcn_msg.cn_msg.id.idx = CN_IDX_PROC;
+  nlcn_msg.cn_msg.id.val = CN_VAL_PROC;
+  nlcn_msg.cn_msg.len = sizeof(enum proc_cn_mcast_op);
+
+  nlcn_msg.cn_mcast = enable ? PROC_CN_MCAST_LISTEN : PROC_CN_MCAST_IGNORE;
+
+  if (send(sock, &nlcn_msg, sizeof(nlcn_msg), 0) == -1) {
+    ERROR("processes plugin: Subscribing to process events failed: %s",
+          STRERRNO);
+    return -1;
+  }
+
+  return 0;
+}
+
+/* ps_tracking_init subscribes to the process events connector, seeds the set
+ * of tracked processes from /proc and starts the thread receiving events. */
+static int ps_tracking_init(void) /* {{{ */
+{
+  struct sockaddr_nl sa_nl = {
+      .nl_family = AF_NETLINK,
+      .nl_groups = CN_IDX_PROC,
+  };
+
+  int sock = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_CONNECTOR);
+  if (sock == -1) {
+    ERROR("processes plugin: socket(NETLINK_CONNECTOR) failed: %s", STRERRNO);
+    return -1;
+  }
+
+  /* Bursts of forks must not overflow the socket while the read callback
+   * holds ps_tasks_lock. */
+  int rcvbuf = 1 << 20;
+  setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+  if (bind(sock, (struct sockaddr *)&sa_nl, sizeof(sa_nl)) != 0) {
+    ERROR("processes plugin: bind(NETLINK_CONNECTOR) failed: %s", STRERRNO);
+    close(sock);
+    return -1;
+  }
+
+  /* Subscribing requires the CAP_NET_ADMIN capability. */
+  if (ps_netlink_listen(sock, true) != 0) {
+    close(sock);
+    return -1;
+  }
+
+  pthread_mutex_lock(&ps_tasks_lock);
+  if (ps_tasks == NULL)
+    ps_tasks = c_avl_create(ps_task_compare);
+  /* Subscribe first, scan second: processes started in between are seen
+   * twice, which is harmless, but none is missed. */
+  if ((ps_tasks == NULL) || (ps_tasks_scan() != 0)) {
+    pthread_mutex_unlock(&ps_tasks_lock);
+    close(sock);
+    return -1;
+  }
+  ps_tasks_resync = false;
+  ps_nl_sock = sock;
+  pthread_mutex_unlock(&ps_tasks_lock);
+
+  int status = plugin_thread_create(&ps_nl_thread, ps_netlink_thread,
+                                    /* arg = */ NULL, "processes nl");
+  if (status != 0) {
+    ERROR("processes plugin: Starting netlink thread failed: %s",
+          STRERROR(status));
+    pthread_mutex_lock(&ps_tasks_lock);
+    ps_nl_sock = -1;
+    pthread_mutex_unlock(&ps_tasks_lock);
+    close(sock);
+    return -1;
+  }
+  ps_nl_thread_running = true;
+
+  INFO("processes plugin: Tracking %d processes using netlink.",
+       c_avl_size(ps_tasks));
+  return 0;
+} /* }}} int ps_tracking_init */
+
+typedef struct {
+  long pid;
+  uint64_t gen;
+  bool classify;
+  bool matched;
+  bool need_delay;
+} ps_candidate_t;
+
+/* ps_read_tracked is the read callback used with "ProcessTracking Netlink".
+ * Only processes matching a selector are read from /proc. The number of
+ * processes per state is not available in this mode, except for the
+ * "running" and "blocked" counts, which are read from /proc/stat. */
+static int ps_read_tracked(void) /* {{{ */
+{
+  ps_candidate_t *candidates = NULL;
+  size_t candidates_num = 0;
+  size_t candidates_size = 0;
+
+  ps_list_reset();
+
+  pthread_mutex_lock(&ps_tasks_lock);
+  if (ps_tasks_resync) {
+    INFO("processes plugin: Process events have been lost. "
+         "Rescanning /proc.");
+    ps_tasks_scan();
+    ps_tasks_resync = false;
+  }
+
+  c_avl_iterator_t *iter = c_avl_get_iterator(ps_tasks);
+  void *key = NULL;
+  ps_task_t *task = NULL;
+  while ((iter != NULL) &&
+         (c_avl_iterator_next(iter, &key, (void *)&task) == 0)) {
+    bool classify = (task->checked_gen != task->gen);
+    if (!classify && !task->matched)
+      continue;
+
+    if (candidates_num >= candidates_size) {
+      size_t new_size = (candidates_size == 0) ? 64 : 2 * candidates_size;
+      ps_candidate_t *tmp =
+          realloc(candidates, new_size * sizeof(*candidates));
+      if (tmp == NULL) {
+        ERROR("processes plugin: ps_read_tracked: realloc failed.");
+        break;
+      }
+      candidates = tmp;
+      candidates_size = new_size;
+    }
+
+    candidates[candidates_num++] = (ps_candidate_t){
+        .pid = task->pid,
+        .gen = task->gen,
+        .classify = classify,
+        .matched = task->matched,
+        .need_delay = task->need_delay,
+    };
+  }
+  c_avl_iterator_destroy(iter);
+  pthread_mutex_unlock(&ps_tasks_lock);
+
+  /* Classify new and changed processes. This is done without holding the
+   * lock, so that the netlink thread isn't blocked by reading /proc. */
+  for (size_t i = 0; i < candidates_num; i++) {
+    ps_candidate_t *c = candidates + i;
+    if (!c->classify)
+      continue;
+
+    if (ps_task_classify(c->pid, &c->matched, &c->need_delay) != 0) {
+      c->matched = false;
+      c->need_delay = false;
+    }
+  }
+
+  process_entry_t *entries = calloc(candidates_num, sizeof(*entries));
+  process_entry_t **delay_entries =
+      calloc(candidates_num, sizeof(*delay_entries));
+  size_t delay_entries_num = 0;
+  if ((candidates_num > 0) && ((entries == NULL) || (delay_entries == NULL))) {
+    ERROR("processes plugin: ps_read_tracked: calloc failed.");
+    candidates_num = 0;
+  }
+
+  for (size_t i = 0; i < candidates_num; i++) {
+    char state;
+
+    if (!candidates[i].matched)
+      continue;
+
+    entries[i].id = candidates[i].pid;
+    if (ps_read_process(candidates[i].pid, entries + i, &state) != 0) {
+      entries[i].id = 0;
+      continue;
+    }
+
+    if (candidates[i].need_delay && (entries[i].num_proc > 0))
+      delay_entries[delay_entries_num++] = entries + i;
+  }
+
+#if HAVE_LIBTASKSTATS
+  ps_delay_batch(delay_entries, delay_entries_num);
+#endif
+
+  for (size_t i = 0; i < candidates_num; i++) {
+    char cmdline[CMDLINE_BUFFER_SIZE];
+    process_entry_t *pse = entries + i;
+
+    if (pse->id == 0)
+      continue;
+
+    ps_list_add(pse->name,
+                ps_get_cmdline((long)pse->id, pse->name, cmdline,
+                               sizeof(cmdline)),
+                pse);
+  }
+
+  /* Write back the classification, unless the process has changed in the
+   * meantime. */
+  pthread_mutex_lock(&ps_tasks_lock);
+  for (size_t i = 0; i < candidates_num; i++) {
+    ps_candidate_t *c = candidates + i;
+    if (!c->classify)
+      continue;
+
+    if ((c_avl_get(ps_tasks, &c->pid, (void *)&task) != 0) ||
+        (task->gen != c->gen))
+      continue;
+
+    task->checked_gen = c->gen;
+    task->matched = c->matched;
+    task->need_delay = c->need_delay;
+  }
+  pthread_mutex_unlock(&ps_tasks_lock);
+
+  sfree(delay_entries);
+  sfree(entries);
+  sfree(candidates);
+
+  ps_submit_state("running", procs_count("procs_running "));
+  ps_submit_state("blocked", procs_count("procs_blocked "));
+
+  for (procstat_t *ps_ptr = list_head_g; ps_ptr != NULL; ps_ptr = ps_ptr->next)
+    ps_submit_proc_list(ps_ptr);
+
+  read_fork_rate();
+
+  want_init = false;
+
+  return 0;
+} /* }}} int ps_read_tracked */
+
+static int ps_shutdown(void) {
+  if (ps_nl_thread_running) {
+    pthread_cancel(ps_nl_thread);
+    pthread_join(ps_nl_thread, /* retval = */ NULL);
+    ps_nl_thread_running = false;
+  }
+
+  pthread_mutex_lock(&ps_tasks_lock);
+  if (ps_nl_sock != -1) {
+    ps_netlink_listen(ps_nl_sock, false);
+    close(ps_nl_sock);
+    ps_nl_sock = -1;
+  }
+
+  if (ps_tasks != NULL) {
+    void *key = NULL;
+    ps_task_t *task = NULL;
+
+    while (c_avl_pick(ps_tasks, &key, (void *)&task) == 0)
+      sfree(task);
+    c_avl_destroy(ps_tasks);
+    ps_tasks = NULL;
+  }
+  pthread_mutex_unlock(&ps_tasks_lock);
+
+  ps_scanners_destroy();
+
+  if (ps_proc_fd != -1) {
+    close(ps_proc_fd);
+    ps_proc_fd = -1;
+  }
+
+#if HAVE_LIBTASKSTATS
+  ts_destroy(taskstats_handle);
+  taskstats_handle = NULL;
+#endif
+
+  return 0;
+} /* int ps_shutdown */
 #endif /*KERNEL_LINUX */
 
 #if KERNEL_SOLARIS
@@ -2078,67 +3154,29 @@ static int ps_read(void) {
   int paging = 0;
   int blocked = 0;
 
-  struct dirent *ent;
-  DIR *proc;
-  long pid;
-
-  char cmdline[CMDLINE_BUFFER_SIZE];
+  if (ps_nl_sock != -1)
+    return ps_read_tracked();
 
-  int status;
-  process_entry_t pse;
-  char state;
-
-  running = sleeping = zombies = stopped = paging = blocked = 0;
   ps_list_reset();
 
-  if ((proc = opendir("/proc")) == NULL) {
-    ERROR("Cannot open `/proc': %s", STRERRNO);
+  if (ps_scan() != 0)
     return -1;
-  }
-
-  while ((ent = readdir(proc)) != NULL) {
-    if (!isdigit(ent->d_name[0]))
-      continue;
-
-    if ((pid = atol(ent->d_name)) < 1)
-      continue;
-
-    memset(&pse, 0, sizeof(pse));
-    pse.id = pid;
 
-    status = ps_read_process(pid, &pse, &state);
-    if (status != 0) {
-      DEBUG("ps_read_process failed: %i", status);
-      continue;
-    }
+  for (size_t i = 0; i < ps_scanners_num; i++) {
+    ps_scanner_t *s = ps_scanners + i;
 
-    switch (state) {
-    case 'R':
-      running++;
-      break;
-    case 'S':
-      sleeping++;
-      break;
-    case 'D':
-      blocked++;
-      break;
-    case 'Z':
-      zombies++;
-      break;
-    case 'T':
-      stopped++;
-      break;
-    case 'W':
-      paging++;
-      break;
-    }
+    running += s->running;
+    sleeping += s->sleeping;
+    zombies += s->zombies;
+    stopped += s->stopped;
+    paging += s->paging;
+    blocked += s->blocked;
 
-    ps_list_add(pse.name,
-                ps_get_cmdline(pid, pse.name, cmdline, sizeof(cmdline)), &pse);
+    for (size_t j = 0; j < s->results_num; j++)
+      ps_list_add(s->results[j].entry.name, s->results[j].cmdline,
+                  &s->results[j].entry);
   }
 
-  closedir(proc);
-
   /* get procs_running from /proc/stat
    * scanning /proc/stat AND computing other process stats takes too much time.
    * Consequently, the number of running processes based on the occurences
@@ -2147,7 +3185,7 @@ static int ps_read(void) {
    * stat(s).
    * The 'procs_running' number in /proc/stat on the other hand is more
    * accurate, and can be retrieved in a single 'read' call. */
-  running = procs_running();
+  running = procs_count("procs_running ");
 
   ps_submit_state("running", running);
   ps_submit_state("sleeping", sleeping);
@@ -2889,4 +3927,7 @@ void module_register(void) {
   plugin_register_complex_config("processes", ps_config);
   plugin_register_init("processes", ps_init);
   plugin_register_read("processes", ps_read);
+#if KERNEL_LINUX
+  plugin_register_shutdown("processes", ps_shutdown);
+#endif
 } /* void module_register */
@@ -29,6 +29,7 @@
 #include "plugin.h"
 #include "utils/common/common.h"
 #include "utils/ignorelist/ignorelist.h"
+#include "utils/procfs/procfs.h"
 
 #if !KERNEL_LINUX
 #error "No applicable input method."
@@ -48,6 +49,9 @@ static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static ignorelist_t *values_list;
 
+static cu_procfs_t *snmp_file;
+static cu_procfs_t *netstat_file;
+
 /*
  * Functions
  */
@@ -72,10 +76,9 @@ static void submit(const char *protocol_name, const char *str_key,
   plugin_dispatch_values(&vl);
 } /* void submit */
 
-static int read_file(const char *path) {
-  FILE *fh;
-  char key_buffer[4096];
-  char value_buffer[4096];
+static int read_file(cu_procfs_t **pf, const char *path) {
+  char *key_buffer;
+  char *value_buffer;
   char *key_ptr;
   char *value_ptr;
   char *key_fields[256];
@@ -85,31 +88,27 @@ static int read_file(const char *path) {
   int status;
   int i;
 
-  fh = fopen(path, "r");
-  if (fh == NULL) {
-    ERROR("protocols plugin: fopen (%s) failed: %s.", path, STRERRNO);
+  if ((*pf == NULL) && ((*pf = cu_procfs_open(path)) == NULL)) {
+    ERROR("protocols plugin: open (%s) failed: %s.", path, STRERRNO);
+    return -1;
+  }
+
+  char *cursor = cu_procfs_read(*pf, NULL);
+  if (cursor == NULL) {
+    ERROR("protocols plugin: Reading from %s failed: %s.", path, STRERRNO);
     return -1;
   }
 
   status = -1;
   while (42) {
-    clearerr(fh);
-    key_ptr = fgets(key_buffer, sizeof(key_buffer), fh);
-    if (key_ptr == NULL) {
-      if (feof(fh) != 0) {
-        status = 0;
-        break;
-      } else if (ferror(fh) != 0) {
-        ERROR("protocols plugin: Reading from %s failed.", path);
-        break;
-      } else {
-        ERROR("protocols plugin: fgets failed for an unknown reason.");
-        break;
-      }
-    } /* if (key_ptr == NULL) */
-
-    value_ptr = fgets(value_buffer, sizeof(value_buffer), fh);
-    if (value_ptr == NULL) {
+    key_buffer = cu_procfs_line(&cursor);
+    if (key_buffer == NULL) {
+      status = 0;
+      break;
+    }
+
+    value_buffer = cu_procfs_line(&cursor);
+    if (value_buffer == NULL) {
       ERROR("protocols plugin: read_file (%s): Could not read values line.",
             path);
       break;
@@ -166,8 +165,6 @@ static int read_file(const char *path) {
     } /* for (i = 0; i < key_fields_num; i++) */
   }   /* while (42) */
 
-  fclose(fh);
-
   return status;
 } /* int read_file */
 
@@ -175,11 +172,11 @@ static int protocols_read(void) {
   int status;
   int success = 0;
 
-  status = read_file(SNMP_FILE);
+  status = read_file(&snmp_file, SNMP_FILE);
   if (status == 0)
     success++;
 
-  status = read_file(NETSTAT_FILE);
+  status = read_file(&netstat_file, NETSTAT_FILE);
   if (status == 0)
     success++;
 
@@ -207,8 +204,17 @@ static int protocols_config(const char *key, const char *value) {
   return 0;
 } /* int protocols_config */
 
+static int protocols_shutdown(void) {
+  cu_procfs_close(snmp_file);
+  snmp_file = NULL;
+  cu_procfs_close(netstat_file);
+  netstat_file = NULL;
+  return 0;
+} /* int protocols_shutdown */
+
 void module_register(void) {
   plugin_register_config("protocols", protocols_config, config_keys,
                          config_keys_num);
   plugin_register_read("protocols", protocols_read);
+  plugin_register_shutdown("protocols", protocols_shutdown);
 } /* void module_register */
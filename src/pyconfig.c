@@ -154,6 +154,7 @@ static PyObject *Config_repr(PyObject *s) {
 
 static int Config_traverse(PyObject *self, visitproc visit, void *arg) {
   Config *c = (Config *)self;
+  CPY_HEAP_TYPE_VISIT(self);
   Py_VISIT(c->parent);
   Py_VISIT(c->key);
   Py_VISIT(c->values);
@@ -171,8 +172,11 @@ static int Config_clear(PyObject *self) {
 }
 
 static void Config_dealloc(PyObject *self) {
+  PyTypeObject *type = Py_TYPE(self);
+  PyObject_GC_UnTrack(self);
   Config_clear(self);
-  self->ob_type->tp_free(self);
+  type->tp_free(self);
+  CPY_HEAP_TYPE_DECREF(type);
 }
 
 static PyMemberDef Config_members[] = {
@@ -221,3 +225,20 @@ PyTypeObject ConfigType = {
     0,               /* tp_alloc */
     Config_new       /* tp_new */
 };
+
+#ifdef CPY_SUBINTERPRETERS
+static PyType_Slot Config_slots[] = {{Py_tp_dealloc, Config_dealloc},
+                                     {Py_tp_repr, Config_repr},
+                                     {Py_tp_doc, config_doc},
+                                     {Py_tp_traverse, Config_traverse},
+                                     {Py_tp_clear, Config_clear},
+                                     {Py_tp_members, Config_members},
+                                     {Py_tp_init, Config_init},
+                                     {Py_tp_new, Config_new},
+                                     {0, NULL}};
+
+PyType_Spec ConfigSpec = {"collectd.Config", sizeof(Config), 0,
+                          Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE |
+                              Py_TPFLAGS_HAVE_GC,
+                          Config_slots};
+#endif
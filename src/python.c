@@ -32,16 +32,117 @@
 #include "collectd.h"
 
 #include "utils/common/common.h"
+#include "utils_complain.h"
 
 #include "cpython.h"
 
+/* An interpreter running Python code for us. Everything runs in the main
+ * interpreter unless "SubInterpreters" is enabled. Then every imported module
+ * gets an interpreter with its own GIL, so that its callbacks can run in
+ * parallel to those of other modules. */
+typedef struct cpy_interp_s cpy_interp_t;
+
+#ifdef CPY_SUBINTERPRETERS
+/* The thread state of one thread in one interpreter. It is created the first
+ * time the thread runs code in that interpreter and kept until the thread
+ * exits. */
+typedef struct cpy_tstate_s {
+  cpy_interp_t *interp;
+  PyThreadState *tstate; /* NULL once deleted by cpy_interp_delete_threads(). */
+  struct cpy_tstate_s *next_thread; /* Same thread, other interpreters. */
+  struct cpy_tstate_s *next_interp; /* Same interpreter, other threads. */
+} cpy_tstate_t;
+#endif
+
+struct cpy_interp_s {
+  PyObject *collectd_error;
+  PyObject *format_exception;
+#ifdef CPY_SUBINTERPRETERS
+  char *name;
+  PyInterpreterState *interp;
+  PyThreadState *tstate; /* The thread state it was created with. */
+  cpy_tstate_t *threads; /* Protected by cpy_tstate_lock. */
+  cpy_types_t types;
+  struct cpy_interp_s *next;
+#endif
+};
+
 typedef struct cpy_callback_s {
   char *name;
   PyObject *callback;
   PyObject *data;
+  cpy_interp_t *interp; /* The interpreter the callback was registered in. */
   struct cpy_callback_s *next;
 } cpy_callback_t;
 
+typedef struct {
+  PyGILState_STATE gil_state;
+#ifdef CPY_SUBINTERPRETERS
+  bool locked;           /* False if the thread already ran in the interpreter. */
+  PyThreadState *prev;   /* Thread state of another interpreter, swapped out. */
+  PyThreadState *tstate; /* NULL if the PyGILState API was used. */
+  bool temporary;
+#endif
+} cpy_lock_t;
+
+/* These two macros are basically Py_BEGIN_ALLOW_THREADS and
+ * Py_BEGIN_ALLOW_THREADS
+ * from the other direction. If a Python thread calls a C function
+ * Py_BEGIN_ALLOW_THREADS is used to allow other python threads to run because
+ * we don't intend to call any Python functions.
+ *
+ * These two macros are used whenever a C thread intends to call some Python
+ * function, usually because some registered callback was triggered.
+ * Just like Py_BEGIN_ALLOW_THREADS it opens a block so these macros have to be
+ * used in pairs. They acquire the GIL of the given interpreter and make a
+ * thread state of this thread in that interpreter the current one. This means
+ * this thread is now allowed to execute Python code in it. */
+
+#define CPY_LOCK_THREADS(interp)                                               \
+  {                                                                            \
+    cpy_lock_t cpy_lock;                                                       \
+    cpy_interp_lock(&cpy_lock, (interp));
+
+#define CPY_RETURN_FROM_THREADS                                                \
+  cpy_interp_unlock(&cpy_lock);                                                \
+  return
+
+#define CPY_RELEASE_THREADS                                                    \
+  cpy_interp_unlock(&cpy_lock);                                                \
+  }
+
+/* A value list waiting in the queue of a batch writer. "vl.values" and
+ * "vl.meta" are owned copies. */
+typedef struct {
+  const data_set_t *ds;
+  value_list_t vl;
+} cpy_write_item_t;
+
+/* Writers registered with register_write_batch(). The write callback only
+ * copies the value list into a bounded queue. The writer's thread takes
+ * whatever has accumulated, up to "batch_size" value lists, converts it and
+ * hands it to Python as one list, with a single GIL acquisition. When the
+ * queue is full new values are dropped, so that a slow Python writer can not
+ * block the write threads. */
+typedef struct {
+  cpy_callback_t c; /* Must be first, see cpy_destroy_user_data(). */
+  pthread_t thread;
+  bool thread_running;
+  bool free_on_exit;
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  cpy_write_item_t *queue;
+  size_t queue_limit;
+  size_t queue_head;
+  size_t queue_len;
+  size_t batch_size;
+  bool shutdown;
+
+  uint64_t dropped;
+  c_complain_t complaint;
+} cpy_write_batch_t;
+
 static char log_doc[] = "This function sends a string to all logging plugins.";
 
 static char get_ds_doc[] =
@@ -62,6 +163,17 @@ static char flush_doc[] = "flush([plugin][, timeout][, identifier]) -> None\n"
                           "\n"
                           "Flushes the cache of another plugin.";
 
+static char dispatch_many_doc[] =
+    "dispatch_many(template, type_instances, values) -> None\n"
+    "\n"
+    "Dispatch one value list for each entry of 'type_instances' in one go.\n"
+    "All other fields, including the type, the time and meta data, are taken\n"
+    "from the Values object 'template'. 'values' holds the values of all\n"
+    "value lists one after the other, that is len(type_instances) times the\n"
+    "number of data sources of the type. It is read without creating Python\n"
+    "objects if it supports the buffer protocol, for example array.array('d')\n"
+    "or a contiguous numpy array; any other sequence of numbers works, too.";
+
 static char unregister_doc[] =
     "Unregisters a callback. This function needs exactly one parameter either\n"
     "the function to unregister or the callback identifier to unregister.";
@@ -172,6 +284,37 @@ static char reg_write_doc[] =
     "data: The optional data parameter passed to the register function.\n"
     "    If the parameter was omitted it will be omitted here, too.";
 
+static char reg_write_batch_doc[] =
+    "register_write_batch(callback[, data][, name][, batch_size][, "
+    "queue_limit])\n"
+    "    -> identifier\n"
+    "\n"
+    "Register a callback function to receive values dispatched by other "
+    "plugins\n"
+    "in batches.\n"
+    "'callback' is a callable object that will be called with a list of up "
+    "to\n"
+    "    'batch_size' Values objects, from a thread of its own.\n"
+    "'data' is an optional object that will be passed back to the callback\n"
+    "    function every time it is called.\n"
+    "'name' is an optional identifier for this callback. The default name\n"
+    "    is 'python.<module>'.\n"
+    "'batch_size' is the maximum number of Values objects passed to one "
+    "call.\n"
+    "    Defaults to 1024.\n"
+    "'queue_limit' is the number of values which may wait for the callback.\n"
+    "    If the queue is full, new values are dropped. Defaults to 65536.\n"
+    "'identifier' is the full identifier assigned to this callback.\n"
+    "\n"
+    "Values are queued while the callback runs and delivered with the next "
+    "call,\n"
+    "so a slow callback does not block the other write plugins.\n"
+    "The callback function will be called with one or two parameters:\n"
+    "values: A list of Values objects which are copies of the dispatched "
+    "values.\n"
+    "data: The optional data parameter passed to the register function.\n"
+    "    If the parameter was omitted it will be omitted here, too.";
+
 static char reg_notification_doc[] =
     "register_notification(callback[, data][, name]) -> identifier\n"
     "\n"
@@ -250,29 +393,253 @@ static bool do_interactive;
 
 static PyThreadState *state;
 
-static PyObject *sys_path, *cpy_format_exception, *CollectdError;
+static PyObject *sys_path;
+
+static cpy_interp_t cpy_main_interp;
+
+#ifdef CPY_SUBINTERPRETERS
+static bool cpy_use_subinterpreters;
+static bool cpy_log_traces;
+/* Only changed by cpy_config() and cpy_finalize(). */
+static cpy_interp_t *cpy_subinterpreters;
+/* "ModulePath" directories, added to the path of every new interpreter. */
+static char **cpy_module_paths;
+static size_t cpy_module_paths_num;
+
+static pthread_key_t cpy_tstate_key;
+static pthread_mutex_t cpy_tstate_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#if PY_VERSION_HEX >= 0x030D0000
+#define CPY_TSTATE_GET_UNCHECKED PyThreadState_GetUnchecked
+#else
+#define CPY_TSTATE_GET_UNCHECKED _PyThreadState_UncheckedGet
+#endif
+#endif
 
 static cpy_callback_t *cpy_config_callbacks;
 static cpy_callback_t *cpy_init_callbacks;
 static cpy_callback_t *cpy_shutdown_callbacks;
 
-/* Make sure to hold the GIL while modifying these. */
+/* Protects the lists above and these two. With sub-interpreters there is more
+ * than one GIL, so holding one is not enough. */
+static pthread_mutex_t cpy_callbacks_lock = PTHREAD_MUTEX_INITIALIZER;
 static int cpy_shutdown_triggered;
 static int cpy_num_callbacks;
 
+/* You must hold the GIL to call this function! */
+static cpy_interp_t *cpy_interp_current(void) {
+#ifdef CPY_SUBINTERPRETERS
+  PyInterpreterState *interp = PyInterpreterState_Get();
+  for (cpy_interp_t *i = cpy_subinterpreters; i != NULL; i = i->next)
+    if (i->interp == interp)
+      return i;
+#endif
+  return &cpy_main_interp;
+}
+
+#ifdef CPY_SUBINTERPRETERS
+cpy_types_t *cpy_types_current(void) { return &cpy_interp_current()->types; }
+
+/* Thread-specific data destructor: deletes the thread's states in all
+ * interpreters. */
+static void cpy_tstate_destroy(void *arg) {
+  cpy_tstate_t *next;
+
+  for (cpy_tstate_t *t = arg; t != NULL; t = next) {
+    next = t->next_thread;
+
+    pthread_mutex_lock(&cpy_tstate_lock);
+    PyThreadState *tstate = t->tstate;
+    if (tstate != NULL) {
+      cpy_tstate_t **prev = &t->interp->threads;
+      while (*prev != t)
+        prev = &(*prev)->next_interp;
+      *prev = t->next_interp;
+      t->tstate = NULL;
+    }
+    pthread_mutex_unlock(&cpy_tstate_lock);
+
+    if (tstate != NULL) {
+      PyEval_RestoreThread(tstate);
+      PyThreadState_Clear(tstate);
+      PyThreadState_DeleteCurrent();
+    }
+    free(t);
+  }
+}
+
+/* Remembers "tstate" as the state of this thread in the interpreter. */
+static int cpy_tstate_add(cpy_interp_t *i, PyThreadState *tstate) {
+  cpy_tstate_t *t = calloc(1, sizeof(*t));
+  if (t == NULL)
+    return ENOMEM;
+  t->interp = i;
+  t->tstate = tstate;
+  t->next_thread = pthread_getspecific(cpy_tstate_key);
+  pthread_setspecific(cpy_tstate_key, t);
+
+  pthread_mutex_lock(&cpy_tstate_lock);
+  t->next_interp = i->threads;
+  i->threads = t;
+  pthread_mutex_unlock(&cpy_tstate_lock);
+  return 0;
+}
+
+/* Returns the state of this thread in the interpreter, creating it if
+ * necessary. Returns NULL if that failed. */
+static PyThreadState *cpy_tstate_get(cpy_interp_t *i) {
+  PyThreadState *tstate;
+
+  for (cpy_tstate_t *t = pthread_getspecific(cpy_tstate_key); t != NULL;
+       t = t->next_thread)
+    if (t->interp == i)
+      return t->tstate;
+
+  tstate = PyThreadState_New(i->interp);
+  if (tstate == NULL)
+    return NULL;
+  if (cpy_tstate_add(i, tstate) != 0) {
+    PyThreadState_Delete(tstate);
+    return NULL;
+  }
+  return tstate;
+}
+
+/* Deletes the states other threads have in the interpreter. You must hold
+ * its GIL and the other threads must not use it anymore. */
+static void cpy_interp_delete_threads(cpy_interp_t *i) {
+  pthread_mutex_lock(&cpy_tstate_lock);
+  while (i->threads != NULL) {
+    cpy_tstate_t *t = i->threads;
+    PyThreadState *tstate = t->tstate;
+    i->threads = t->next_interp;
+    t->tstate = NULL;
+    if (tstate == CPY_TSTATE_GET_UNCHECKED())
+      continue; /* Deleted by Py_EndInterpreter() or Py_Finalize(). */
+    pthread_mutex_unlock(&cpy_tstate_lock);
+    PyThreadState_Clear(tstate);
+    PyThreadState_Delete(tstate);
+    pthread_mutex_lock(&cpy_tstate_lock);
+  }
+  pthread_mutex_unlock(&cpy_tstate_lock);
+}
+#endif
+
+static void cpy_interp_lock(cpy_lock_t *lock, cpy_interp_t *i) {
+#ifdef CPY_SUBINTERPRETERS
+  PyThreadState *current = CPY_TSTATE_GET_UNCHECKED();
+
+  *lock = (cpy_lock_t){.locked = true};
+  if (current != NULL) {
+    if (PyThreadState_GetInterpreter(current) == i->interp) {
+      lock->locked = false;
+      return;
+    }
+    lock->prev = PyEval_SaveThread();
+  }
+
+  /* The PyGILState API hands out the thread state of whatever interpreter the
+   * thread ran last, so it only works as long as there is just one. */
+  if (cpy_subinterpreters == NULL) {
+    lock->gil_state = PyGILState_Ensure();
+    return;
+  }
+
+  lock->tstate = cpy_tstate_get(i);
+  if (lock->tstate == NULL) {
+    /* Use a thread state just this once. */
+    lock->tstate = PyThreadState_New(i->interp);
+    lock->temporary = true;
+  }
+  PyEval_RestoreThread(lock->tstate);
+#else
+  lock->gil_state = PyGILState_Ensure();
+#endif
+}
+
+static void cpy_interp_unlock(cpy_lock_t *lock) {
+#ifdef CPY_SUBINTERPRETERS
+  if (!lock->locked)
+    return;
+  if (lock->tstate == NULL) {
+    PyGILState_Release(lock->gil_state);
+  } else if (lock->temporary) {
+    PyThreadState_Clear(lock->tstate);
+    PyThreadState_DeleteCurrent();
+  } else {
+    PyEval_SaveThread();
+  }
+  if (lock->prev != NULL)
+    PyEval_RestoreThread(lock->prev);
+#else
+  PyGILState_Release(lock->gil_state);
+#endif
+}
+
+/* Drops the objects we keep in the interpreter. You must hold its GIL. */
+static void cpy_interp_clear(cpy_interp_t *i) {
+  Py_CLEAR(i->collectd_error);
+  Py_CLEAR(i->format_exception);
+#ifdef CPY_SUBINTERPRETERS
+  Py_CLEAR(i->types.Config);
+  Py_CLEAR(i->types.PluginData);
+  Py_CLEAR(i->types.Values);
+  Py_CLEAR(i->types.Notification);
+  Py_CLEAR(i->types.Signed);
+  Py_CLEAR(i->types.Unsigned);
+#endif
+}
+
+/* Ends all sub-interpreters and shuts down Python. Called when the last
+ * callback is gone after shutdown. You must not hold any GIL. */
+static void cpy_finalize(void) {
+  cpy_lock_t lock;
+
+  /* Never released: there is no GIL after Py_Finalize(). */
+  cpy_interp_lock(&lock, &cpy_main_interp);
+#ifdef CPY_SUBINTERPRETERS
+  PyThreadState *main_tstate = PyEval_SaveThread();
+  for (cpy_interp_t *i = cpy_subinterpreters; i != NULL; i = i->next) {
+    PyEval_RestoreThread(i->tstate);
+    cpy_interp_clear(i);
+    cpy_interp_delete_threads(i);
+    Py_EndInterpreter(i->tstate);
+  }
+  PyEval_RestoreThread(main_tstate);
+
+  while (cpy_subinterpreters != NULL) {
+    cpy_interp_t *i = cpy_subinterpreters;
+    cpy_subinterpreters = i->next;
+    free(i->name);
+    free(i);
+  }
+  strarray_free(cpy_module_paths, cpy_module_paths_num);
+  cpy_module_paths = NULL;
+  cpy_module_paths_num = 0;
+
+  cpy_interp_delete_threads(&cpy_main_interp);
+#endif
+  cpy_interp_clear(&cpy_main_interp);
+  Py_Finalize();
+}
+
 static void cpy_destroy_user_data(void *data) {
   cpy_callback_t *c = data;
+  bool finalize;
+
   free(c->name);
-  CPY_LOCK_THREADS
+  CPY_LOCK_THREADS(c->interp)
   Py_DECREF(c->callback);
   Py_XDECREF(c->data);
+  CPY_RELEASE_THREADS
   free(c);
+
+  pthread_mutex_lock(&cpy_callbacks_lock);
   --cpy_num_callbacks;
-  if (!cpy_num_callbacks && cpy_shutdown_triggered) {
-    Py_Finalize();
-    return;
-  }
-  CPY_RELEASE_THREADS
+  finalize = !cpy_num_callbacks && cpy_shutdown_triggered;
+  pthread_mutex_unlock(&cpy_callbacks_lock);
+  if (finalize)
+    cpy_finalize();
 }
 
 /* You must hold the GIL to call this function!
@@ -309,12 +676,14 @@ void cpy_log_exception(const char *context) {
   int l = 0, collectd_error;
   const char *typename = NULL, *message = NULL;
   PyObject *type, *value, *traceback, *tn, *m, *list;
+  cpy_interp_t *interp = cpy_interp_current();
 
   PyErr_Fetch(&type, &value, &traceback);
   PyErr_NormalizeException(&type, &value, &traceback);
   if (type == NULL)
     return;
-  collectd_error = PyErr_GivenExceptionMatches(value, CollectdError);
+  collectd_error =
+      PyErr_GivenExceptionMatches(value, interp->collectd_error);
   tn = PyObject_GetAttrString(type, "__name__"); /* New reference. */
   m = PyObject_Str(value);                       /* New reference. */
   if (tn != NULL)
@@ -335,14 +704,14 @@ void cpy_log_exception(const char *context) {
   Py_END_ALLOW_THREADS;
   Py_XDECREF(tn);
   Py_XDECREF(m);
-  if (!cpy_format_exception || !traceback || collectd_error) {
+  if (!interp->format_exception || !traceback || collectd_error) {
     PyErr_Clear();
     Py_DECREF(type);
     Py_XDECREF(value);
     Py_XDECREF(traceback);
     return;
   }
-  list = PyObject_CallFunction(cpy_format_exception, "NNN", type, value,
+  list = PyObject_CallFunction(interp->format_exception, "NNN", type, value,
                                traceback); /* New reference. Steals references
                                               from "type", "value" and
                                               "traceback". */
@@ -384,7 +753,7 @@ static int cpy_read_callback(user_data_t *data) {
   cpy_callback_t *c = data->data;
   PyObject *ret;
 
-  CPY_LOCK_THREADS
+  CPY_LOCK_THREADS(c->interp)
   ret = PyObject_CallFunctionObjArgs(c->callback, c->data,
                                      (void *)0); /* New reference. */
   if (ret == NULL) {
@@ -398,18 +767,17 @@ static int cpy_read_callback(user_data_t *data) {
   return 0;
 }
 
-static int cpy_write_callback(const data_set_t *ds,
-                              const value_list_t *value_list,
-                              user_data_t *data) {
-  cpy_callback_t *c = data->data;
-  PyObject *ret, *list, *temp, *dict = NULL;
+/* Converts a value list into a new Values object. You must hold the GIL.
+ * Returns NULL if the conversion failed; the error has been logged then. */
+static Values *cpy_build_values(const data_set_t *ds,
+                                const value_list_t *value_list) {
+  PyObject *list, *temp, *dict = NULL;
   Values *v;
 
-  CPY_LOCK_THREADS
   list = PyList_New(value_list->values_len); /* New reference. */
   if (list == NULL) {
     cpy_log_exception("write callback");
-    CPY_RETURN_FROM_THREADS 0;
+    return NULL;
   }
   for (size_t i = 0; i < value_list->values_len; ++i) {
     if (ds->ds[i].type == DS_TYPE_COUNTER) {
@@ -428,12 +796,12 @@ static int cpy_write_callback(const data_set_t *ds,
       ERROR("cpy_write_callback: Unknown value type %d.", ds->ds[i].type);
       Py_END_ALLOW_THREADS;
       Py_DECREF(list);
-      CPY_RETURN_FROM_THREADS 0;
+      return NULL;
     }
     if (PyErr_Occurred() != NULL) {
       cpy_log_exception("value building for write callback");
       Py_DECREF(list);
-      CPY_RETURN_FROM_THREADS 0;
+      return NULL;
     }
   }
   dict = PyDict_New(); /* New reference. */
@@ -462,7 +830,7 @@ static int cpy_write_callback(const data_set_t *ds,
         if (meta_data_get_signed_int(meta, table[i], &si))
           continue;
         PyObject *sival = PyLong_FromLongLong(si); /* New reference */
-        temp = PyObject_CallFunctionObjArgs((void *)&SignedType, sival,
+        temp = PyObject_CallFunctionObjArgs((void *)CPY_TYPE(Signed), sival,
                                             (void *)0); /* New reference. */
         PyDict_SetItemString(dict, table[i], temp);
         Py_XDECREF(temp);
@@ -471,7 +839,7 @@ static int cpy_write_callback(const data_set_t *ds,
         if (meta_data_get_unsigned_int(meta, table[i], &ui))
           continue;
         PyObject *uval = PyLong_FromUnsignedLongLong(ui); /* New reference */
-        temp = PyObject_CallFunctionObjArgs((void *)&UnsignedType, uval,
+        temp = PyObject_CallFunctionObjArgs((void *)CPY_TYPE(Unsigned), uval,
                                             (void *)0); /* New reference. */
         PyDict_SetItemString(dict, table[i], temp);
         Py_XDECREF(temp);
@@ -508,6 +876,21 @@ static int cpy_write_callback(const data_set_t *ds,
   v->values = list;
   Py_CLEAR(v->meta);
   v->meta = dict; /* Steals a reference. */
+  return v;
+}
+
+static int cpy_write_callback(const data_set_t *ds,
+                              const value_list_t *value_list,
+                              user_data_t *data) {
+  cpy_callback_t *c = data->data;
+  PyObject *ret;
+  Values *v;
+
+  CPY_LOCK_THREADS(c->interp)
+  v = cpy_build_values(ds, value_list); /* New reference. */
+  if (v == NULL) {
+    CPY_RETURN_FROM_THREADS 0;
+  }
   ret = PyObject_CallFunctionObjArgs(c->callback, v, c->data,
                                      (void *)0); /* New reference. */
   Py_XDECREF(v);
@@ -520,13 +903,188 @@ static int cpy_write_callback(const data_set_t *ds,
   return 0;
 }
 
+static void cpy_write_item_free(cpy_write_item_t *item) {
+  sfree(item->vl.values);
+  meta_data_destroy(item->vl.meta);
+  item->vl.meta = NULL;
+}
+
+/* Hands a batch of value lists to the Python callback and frees them. */
+static void cpy_write_batch_deliver(cpy_write_batch_t *w,
+                                    cpy_write_item_t *items, size_t num) {
+  CPY_LOCK_THREADS(w->c.interp)
+  PyObject *list = PyList_New(0); /* New reference. */
+  if (list == NULL) {
+    cpy_log_exception("write callback");
+  } else {
+    for (size_t i = 0; i < num; i++) {
+      Values *v = cpy_build_values(items[i].ds, &items[i].vl);
+      if (v == NULL)
+        continue;
+      PyList_Append(list, (PyObject *)v);
+      Py_DECREF(v);
+    }
+
+    PyObject *ret = PyObject_CallFunctionObjArgs(
+        w->c.callback, list, w->c.data, (void *)0); /* New reference. */
+    if (ret == NULL) {
+      cpy_log_exception("write callback");
+    } else {
+      Py_DECREF(ret);
+    }
+    Py_DECREF(list);
+  }
+  CPY_RELEASE_THREADS
+
+  for (size_t i = 0; i < num; i++)
+    cpy_write_item_free(items + i);
+}
+
+static void cpy_write_batch_free(cpy_write_batch_t *w) {
+  for (size_t i = 0; i < w->queue_len; i++)
+    cpy_write_item_free(w->queue + (w->queue_head + i) % w->queue_limit);
+  sfree(w->queue);
+  pthread_mutex_destroy(&w->lock);
+  pthread_cond_destroy(&w->cond);
+
+  if (w->dropped > 0)
+    WARNING("python plugin: Batch writer \"%s\" dropped %" PRIu64
+            " value lists because its queue was full.",
+            w->c.name, w->dropped);
+
+  cpy_destroy_user_data(w); /* Frees "w". */
+}
+
+static void *cpy_write_batch_thread(void *arg) {
+  cpy_write_batch_t *w = arg;
+
+  cpy_write_item_t *batch = calloc(w->batch_size, sizeof(*batch));
+  if (batch == NULL) {
+    ERROR("python plugin: calloc failed.");
+    return NULL;
+  }
+
+  pthread_mutex_lock(&w->lock);
+  while (true) {
+    while (!w->shutdown && (w->queue_len == 0))
+      pthread_cond_wait(&w->cond, &w->lock);
+    /* cpy_write_batch_destroy() joins us without holding the GIL, so the
+     * queue can still be delivered after "shutdown" was set. */
+    if (w->queue_len == 0)
+      break;
+
+    size_t num = w->queue_len;
+    if (num > w->batch_size)
+      num = w->batch_size;
+    for (size_t i = 0; i < num; i++)
+      batch[i] = w->queue[(w->queue_head + i) % w->queue_limit];
+    w->queue_head = (w->queue_head + num) % w->queue_limit;
+    w->queue_len -= num;
+    pthread_mutex_unlock(&w->lock);
+
+    cpy_write_batch_deliver(w, batch, num);
+
+    pthread_mutex_lock(&w->lock);
+  }
+  bool free_on_exit = w->free_on_exit;
+  pthread_mutex_unlock(&w->lock);
+
+  sfree(batch);
+  if (free_on_exit)
+    cpy_write_batch_free(w);
+  return NULL;
+}
+
+static int cpy_write_batch_callback(const data_set_t *ds,
+                                    const value_list_t *value_list,
+                                    user_data_t *data) {
+  cpy_write_batch_t *w = data->data;
+
+  /* Copy the value list before taking the lock. */
+  cpy_write_item_t item = {.ds = ds, .vl = *value_list};
+  item.vl.values =
+      malloc(value_list->values_len * sizeof(*value_list->values));
+  if (item.vl.values == NULL) {
+    ERROR("python plugin: malloc failed.");
+    return ENOMEM;
+  }
+  memcpy(item.vl.values, value_list->values,
+         value_list->values_len * sizeof(*value_list->values));
+  item.vl.meta = NULL;
+  if (value_list->meta != NULL)
+    item.vl.meta = meta_data_clone(value_list->meta);
+
+  pthread_mutex_lock(&w->lock);
+  if (w->queue_len >= w->queue_limit) {
+    w->dropped++;
+    pthread_mutex_unlock(&w->lock);
+    c_complain(LOG_WARNING, &w->complaint,
+               "python plugin: The queue of batch writer \"%s\" is full, "
+               "dropping values.",
+               w->c.name);
+    cpy_write_item_free(&item);
+    return ENOBUFS;
+  }
+  w->queue[(w->queue_head + w->queue_len) % w->queue_limit] = item;
+  w->queue_len++;
+  pthread_cond_signal(&w->cond);
+  pthread_mutex_unlock(&w->lock);
+
+  c_release(LOG_INFO, &w->complaint,
+            "python plugin: The queue of batch writer \"%s\" accepts values "
+            "again.",
+            w->c.name);
+  return 0;
+}
+
+/* Returns true if this thread holds the GIL of any interpreter. */
+static bool cpy_holds_gil(void) {
+#if defined(CPY_SUBINTERPRETERS)
+  return CPY_TSTATE_GET_UNCHECKED() != NULL;
+#elif PY_VERSION_HEX >= 0x03040000
+  return PyGILState_Check();
+#else
+  return false;
+#endif
+}
+
+static void cpy_write_batch_destroy(void *data) {
+  cpy_write_batch_t *w = data;
+
+  pthread_mutex_lock(&w->lock);
+  w->shutdown = true;
+  pthread_cond_signal(&w->cond);
+  if (w->thread_running && pthread_equal(pthread_self(), w->thread)) {
+    /* unregister_write() was called by the Python callback on this very
+     * thread, which cannot join itself. */
+    w->free_on_exit = true;
+    pthread_mutex_unlock(&w->lock);
+    pthread_detach(w->thread);
+    return;
+  }
+  pthread_mutex_unlock(&w->lock);
+
+  if (w->thread_running) {
+    /* The thread needs the GIL to deliver the rest of the queue. */
+    if (cpy_holds_gil()) {
+      Py_BEGIN_ALLOW_THREADS;
+      pthread_join(w->thread, NULL);
+      Py_END_ALLOW_THREADS;
+    } else {
+      pthread_join(w->thread, NULL);
+    }
+  }
+
+  cpy_write_batch_free(w);
+}
+
 static int cpy_notification_callback(const notification_t *notification,
                                      user_data_t *data) {
   cpy_callback_t *c = data->data;
   PyObject *ret, *notify;
   Notification *n;
 
-  CPY_LOCK_THREADS
+  CPY_LOCK_THREADS(c->interp)
   PyObject *dict = PyDict_New(); /* New reference. */
   for (notification_meta_t *meta = notification->meta; meta != NULL;
        meta = meta->next) {
@@ -538,7 +1096,7 @@ static int cpy_notification_callback(const notification_t *notification,
       Py_XDECREF(temp);
     } else if (meta->type == NM_TYPE_SIGNED_INT) {
       PyObject *sival = PyLong_FromLongLong(meta->nm_value.nm_signed_int);
-      temp = PyObject_CallFunctionObjArgs((void *)&SignedType, sival,
+      temp = PyObject_CallFunctionObjArgs((void *)CPY_TYPE(Signed), sival,
                                           (void *)0); /* New reference. */
       PyDict_SetItemString(dict, meta->name, temp);
       Py_XDECREF(temp);
@@ -546,7 +1104,7 @@ static int cpy_notification_callback(const notification_t *notification,
     } else if (meta->type == NM_TYPE_UNSIGNED_INT) {
       PyObject *uval =
           PyLong_FromUnsignedLongLong(meta->nm_value.nm_unsigned_int);
-      temp = PyObject_CallFunctionObjArgs((void *)&UnsignedType, uval,
+      temp = PyObject_CallFunctionObjArgs((void *)CPY_TYPE(Unsigned), uval,
                                           (void *)0); /* New reference. */
       PyDict_SetItemString(dict, meta->name, temp);
       Py_XDECREF(temp);
@@ -591,7 +1149,7 @@ static void cpy_log_callback(int severity, const char *message,
   cpy_callback_t *c = data->data;
   PyObject *ret, *text;
 
-  CPY_LOCK_THREADS
+  CPY_LOCK_THREADS(c->interp)
   text = cpy_string_to_unicode_or_bytes(message); /* New reference. */
   if (c->data == NULL)
     ret = PyObject_CallFunction(
@@ -621,7 +1179,7 @@ static void cpy_flush_callback(int timeout, const char *id, user_data_t *data) {
   cpy_callback_t *c = data->data;
   PyObject *ret, *text;
 
-  CPY_LOCK_THREADS
+  CPY_LOCK_THREADS(c->interp)
   if (id) {
     text = cpy_string_to_unicode_or_bytes(id);
   } else {
@@ -671,9 +1229,12 @@ static PyObject *cpy_register_generic(cpy_callback_t **list_head,
   c->name = strdup(buf);
   c->callback = callback;
   c->data = data;
+  c->interp = cpy_interp_current();
+  pthread_mutex_lock(&cpy_callbacks_lock);
   c->next = *list_head;
   ++cpy_num_callbacks;
   *list_head = c;
+  pthread_mutex_unlock(&cpy_callbacks_lock);
   Py_XDECREF(mod);
   PyMem_Free(name);
   return cpy_string_to_unicode_or_bytes(buf);
@@ -771,6 +1332,7 @@ static PyObject *cpy_register_generic_userdata(void *reg, void *handler,
   c->name = strdup(buf);
   c->callback = callback;
   c->data = data;
+  c->interp = cpy_interp_current();
   c->next = NULL;
 
   register_function(buf, handler,
@@ -779,7 +1341,9 @@ static PyObject *cpy_register_generic_userdata(void *reg, void *handler,
                         .free_func = cpy_destroy_user_data,
                     });
 
+  pthread_mutex_lock(&cpy_callbacks_lock);
   ++cpy_num_callbacks;
+  pthread_mutex_unlock(&cpy_callbacks_lock);
   return cpy_string_to_unicode_or_bytes(buf);
 }
 
@@ -813,6 +1377,7 @@ static PyObject *cpy_register_read(PyObject *self, PyObject *args,
   c->name = strdup(buf);
   c->callback = callback;
   c->data = data;
+  c->interp = cpy_interp_current();
   c->next = NULL;
 
   plugin_register_complex_read(
@@ -822,7 +1387,9 @@ static PyObject *cpy_register_read(PyObject *self, PyObject *args,
           .data = c,
           .free_func = cpy_destroy_user_data,
       });
+  pthread_mutex_lock(&cpy_callbacks_lock);
   ++cpy_num_callbacks;
+  pthread_mutex_unlock(&cpy_callbacks_lock);
   return cpy_string_to_unicode_or_bytes(buf);
 }
 
@@ -838,6 +1405,80 @@ static PyObject *cpy_register_write(PyObject *self, PyObject *args,
                                        (void *)cpy_write_callback, args, kwds);
 }
 
+static PyObject *cpy_register_write_batch(PyObject *self, PyObject *args,
+                                          PyObject *kwds) {
+  char buf[512];
+  cpy_write_batch_t *w = NULL;
+  char *name = NULL;
+  PyObject *callback = NULL, *data = NULL;
+  Py_ssize_t batch_size = 1024, queue_limit = 65536;
+  static char *kwlist[] = {"callback",   "data",        "name",
+                           "batch_size", "queue_limit", NULL};
+
+  if (PyArg_ParseTupleAndKeywords(args, kwds, "O|Oetnn", kwlist, &callback,
+                                  &data, NULL, &name, &batch_size,
+                                  &queue_limit) == 0)
+    return NULL;
+  if (PyCallable_Check(callback) == 0) {
+    PyMem_Free(name);
+    PyErr_SetString(PyExc_TypeError, "callback needs a be a callable object.");
+    return NULL;
+  }
+  if (batch_size < 1 || queue_limit < 1) {
+    PyMem_Free(name);
+    PyErr_SetString(PyExc_ValueError,
+                    "batch_size and queue_limit must be positive.");
+    return NULL;
+  }
+  cpy_build_name(buf, sizeof(buf), callback, name);
+  PyMem_Free(name);
+
+  w = calloc(1, sizeof(*w));
+  if (w == NULL)
+    return PyErr_NoMemory();
+  w->queue = calloc((size_t)queue_limit, sizeof(*w->queue));
+  if (w->queue == NULL) {
+    free(w);
+    return PyErr_NoMemory();
+  }
+
+  Py_INCREF(callback);
+  Py_XINCREF(data);
+
+  w->c.name = strdup(buf);
+  w->c.callback = callback;
+  w->c.data = data;
+  w->c.interp = cpy_interp_current();
+  w->c.next = NULL;
+  w->queue_limit = (size_t)queue_limit;
+  w->batch_size = (size_t)batch_size;
+  C_COMPLAIN_INIT(&w->complaint);
+  pthread_mutex_init(&w->lock, NULL);
+  pthread_cond_init(&w->cond, NULL);
+  pthread_mutex_lock(&cpy_callbacks_lock);
+  ++cpy_num_callbacks;
+  pthread_mutex_unlock(&cpy_callbacks_lock);
+
+  int status = plugin_thread_create(&w->thread, cpy_write_batch_thread, w,
+                                    "python writer");
+  if (status != 0) {
+    PyErr_Format(PyExc_RuntimeError, "Starting the thread of writer '%s' "
+                                     "failed: %s",
+                 buf, STRERROR(status));
+    cpy_write_batch_free(w);
+    return NULL;
+  }
+  w->thread_running = true;
+
+  plugin_register_write(buf, cpy_write_batch_callback,
+                        &(user_data_t){
+                            .data = w,
+                            .free_func = cpy_write_batch_destroy,
+                        });
+
+  return cpy_string_to_unicode_or_bytes(buf);
+}
+
 static PyObject *cpy_register_notification(PyObject *self, PyObject *args,
                                            PyObject *kwds) {
   return cpy_register_generic_userdata((void *)plugin_register_notification,
@@ -933,33 +1574,42 @@ static PyObject *cpy_unregister_generic(cpy_callback_t **list_head,
     cpy_build_name(buf, sizeof(buf), arg, NULL);
     name = buf;
   }
+  pthread_mutex_lock(&cpy_callbacks_lock);
   for (tmp = *list_head; tmp; prev = tmp, tmp = tmp->next)
     if (strcmp(name, tmp->name) == 0)
       break;
 
-  Py_DECREF(arg);
+  if (tmp != NULL) {
+    if (prev == NULL)
+      *list_head = tmp->next;
+    else
+      prev->next = tmp->next;
+  }
+  pthread_mutex_unlock(&cpy_callbacks_lock);
+
   if (tmp == NULL) {
     PyErr_Format(PyExc_RuntimeError, "Unable to unregister %s callback '%s'.",
                  desc, name);
+    Py_DECREF(arg);
     return NULL;
   }
-  /* Yes, this is actually safe. To call this function the caller has to
-   * hold the GIL. Well, safe as long as there is only one GIL anyway ... */
-  if (prev == NULL)
-    *list_head = tmp->next;
-  else
-    prev->next = tmp->next;
+  Py_DECREF(arg);
   cpy_destroy_user_data(tmp);
   Py_RETURN_NONE;
 }
 
 static void cpy_unregister_list(cpy_callback_t **list_head) {
   cpy_callback_t *cur, *next;
-  for (cur = *list_head; cur; cur = next) {
+
+  pthread_mutex_lock(&cpy_callbacks_lock);
+  cur = *list_head;
+  *list_head = NULL;
+  pthread_mutex_unlock(&cpy_callbacks_lock);
+
+  for (; cur; cur = next) {
     next = cur->next;
     cpy_destroy_user_data(cur);
   }
-  *list_head = NULL;
 }
 
 typedef int cpy_unregister_function_t(const char *name);
@@ -1035,6 +1685,8 @@ static PyMethodDef cpy_methods[] = {
     {"error", cpy_error, METH_VARARGS, log_doc},
     {"get_dataset", (PyCFunction)cpy_get_dataset, METH_VARARGS, get_ds_doc},
     {"flush", (PyCFunction)cpy_flush, METH_VARARGS | METH_KEYWORDS, flush_doc},
+    {"dispatch_many", (PyCFunction)cpy_dispatch_many,
+     METH_VARARGS | METH_KEYWORDS, dispatch_many_doc},
     {"register_log", (PyCFunction)cpy_register_log,
      METH_VARARGS | METH_KEYWORDS, reg_log_doc},
     {"register_init", (PyCFunction)cpy_register_init,
@@ -1045,6 +1697,8 @@ static PyMethodDef cpy_methods[] = {
      METH_VARARGS | METH_KEYWORDS, reg_read_doc},
     {"register_write", (PyCFunction)cpy_register_write,
      METH_VARARGS | METH_KEYWORDS, reg_write_doc},
+    {"register_write_batch", (PyCFunction)cpy_register_write_batch,
+     METH_VARARGS | METH_KEYWORDS, reg_write_batch_doc},
     {"register_notification", (PyCFunction)cpy_register_notification,
      METH_VARARGS | METH_KEYWORDS, reg_notification_doc},
     {"register_flush", (PyCFunction)cpy_register_flush,
@@ -1064,6 +1718,7 @@ static PyMethodDef cpy_methods[] = {
 
 static int cpy_shutdown(void) {
   PyObject *ret;
+  bool finalize;
 
   if (!state) {
     printf(
@@ -1078,31 +1733,30 @@ static int cpy_shutdown(void) {
         "================================================================\n");
   }
 
-  CPY_LOCK_THREADS
-
+  /* Read threads have been stopped, so nobody else changes the list. */
   for (cpy_callback_t *c = cpy_shutdown_callbacks; c; c = c->next) {
+    CPY_LOCK_THREADS(c->interp)
     ret = PyObject_CallFunctionObjArgs(c->callback, c->data,
                                        (void *)0); /* New reference. */
     if (ret == NULL)
       cpy_log_exception("shutdown callback");
     else
       Py_DECREF(ret);
+    PyErr_Print();
+    CPY_RELEASE_THREADS
   }
-  PyErr_Print();
 
-  Py_BEGIN_ALLOW_THREADS;
   cpy_unregister_list(&cpy_config_callbacks);
   cpy_unregister_list(&cpy_init_callbacks);
   cpy_unregister_list(&cpy_shutdown_callbacks);
-  cpy_shutdown_triggered = 1;
-  Py_END_ALLOW_THREADS;
 
-  if (!cpy_num_callbacks) {
-    Py_Finalize();
-    return 0;
-  }
+  pthread_mutex_lock(&cpy_callbacks_lock);
+  cpy_shutdown_triggered = 1;
+  finalize = !cpy_num_callbacks;
+  pthread_mutex_unlock(&cpy_callbacks_lock);
 
-  CPY_RELEASE_THREADS
+  if (finalize)
+    cpy_finalize();
   return 0;
 }
 
@@ -1165,6 +1819,13 @@ static int cpy_init(void) {
     return 0;
   }
   main_thread = pthread_self();
+#ifdef CPY_SUBINTERPRETERS
+  if (do_interactive && (cpy_subinterpreters != NULL)) {
+    WARNING("python plugin: \"Interactive\" can not be combined with "
+            "\"SubInterpreters\" and has been disabled.");
+    do_interactive = false;
+  }
+#endif
   if (do_interactive) {
     if (pipe(pipefd)) {
       ERROR("python: Unable to create pipe.");
@@ -1181,16 +1842,18 @@ static int cpy_init(void) {
     PyEval_InitThreads();
     state = PyEval_SaveThread();
   }
-  CPY_LOCK_THREADS
+  /* Read threads have not been started yet, so nobody else changes the
+   * list. */
   for (cpy_callback_t *c = cpy_init_callbacks; c; c = c->next) {
+    CPY_LOCK_THREADS(c->interp)
     ret = PyObject_CallFunctionObjArgs(c->callback, c->data,
                                        (void *)0); /* New reference. */
     if (ret == NULL)
       cpy_log_exception("init callback");
     else
       Py_DECREF(ret);
+    CPY_RELEASE_THREADS
   }
-  CPY_RELEASE_THREADS
 
   return 0;
 }
@@ -1216,7 +1879,7 @@ static PyObject *cpy_oconfig_to_pyconfig(oconfig_item_t *ci, PyObject *parent) {
   }
 
   tmp = cpy_string_to_unicode_or_bytes(ci->key);
-  item = PyObject_CallFunction((void *)&ConfigType, "NONO", tmp, parent, values,
+  item = PyObject_CallFunction((void *)CPY_TYPE(Config), "NONO", tmp, parent, values,
                                Py_None);
   if (item == NULL)
     return NULL;
@@ -1231,20 +1894,132 @@ static PyObject *cpy_oconfig_to_pyconfig(oconfig_item_t *ci, PyObject *parent) {
   return item;
 }
 
+static int cpy_module_add_type(PyObject *module, const char *name,
+                               PyTypeObject *type) {
+  Py_INCREF(type);
+  if (PyModule_AddObject(module, name, (PyObject *)type) != 0) {
+    Py_DECREF(type);
+    return -1;
+  }
+  return 0;
+}
+
+/* Populates the collectd module. With sub-interpreters this runs once in every
+ * interpreter importing the module. */
+static int cpy_module_exec(PyObject *module) {
+  cpy_interp_t *interp = cpy_interp_current();
+  PyObject *errordict;
+
+#ifdef CPY_SUBINTERPRETERS
+  cpy_types_t *t = &interp->types;
+
+  t->Config =
+      (PyTypeObject *)PyType_FromModuleAndSpec(module, &ConfigSpec, NULL);
+  t->PluginData =
+      (PyTypeObject *)PyType_FromModuleAndSpec(module, &PluginDataSpec, NULL);
+  if ((t->Config == NULL) || (t->PluginData == NULL))
+    return -1;
+  t->Values = (PyTypeObject *)PyType_FromModuleAndSpec(
+      module, &ValuesSpec, (PyObject *)t->PluginData);
+  t->Notification = (PyTypeObject *)PyType_FromModuleAndSpec(
+      module, &NotificationSpec, (PyObject *)t->PluginData);
+  t->Signed = (PyTypeObject *)PyType_FromModuleAndSpec(
+      module, &SignedSpec, (PyObject *)&PyLong_Type);
+  t->Unsigned = (PyTypeObject *)PyType_FromModuleAndSpec(
+      module, &UnsignedSpec, (PyObject *)&PyLong_Type);
+  if ((t->Values == NULL) || (t->Notification == NULL) ||
+      (t->Signed == NULL) || (t->Unsigned == NULL))
+    return -1;
+#else
+  if (PyType_Ready(&ConfigType) == -1)
+    return -1;
+  if (PyType_Ready(&PluginDataType) == -1)
+    return -1;
+  ValuesType.tp_base = &PluginDataType;
+  if (PyType_Ready(&ValuesType) == -1)
+    return -1;
+  NotificationType.tp_base = &PluginDataType;
+  if (PyType_Ready(&NotificationType) == -1)
+    return -1;
+  SignedType.tp_base = &PyLong_Type;
+  if (PyType_Ready(&SignedType) == -1)
+    return -1;
+  UnsignedType.tp_base = &PyLong_Type;
+  if (PyType_Ready(&UnsignedType) == -1)
+    return -1;
+#endif
+
+  if ((cpy_module_add_type(module, "Config", CPY_TYPE(Config)) != 0) ||
+      (cpy_module_add_type(module, "Values", CPY_TYPE(Values)) != 0) ||
+      (cpy_module_add_type(module, "Notification", CPY_TYPE(Notification)) !=
+       0) ||
+      (cpy_module_add_type(module, "Signed", CPY_TYPE(Signed)) != 0) ||
+      (cpy_module_add_type(module, "Unsigned", CPY_TYPE(Unsigned)) != 0))
+    return -1;
+
+  errordict = PyDict_New();
+  PyDict_SetItemString(
+      errordict, "__doc__",
+      cpy_string_to_unicode_or_bytes(CollectdError_doc)); /* New reference. */
+  interp->collectd_error =
+      PyErr_NewException("collectd.CollectdError", NULL, errordict);
+  if (interp->collectd_error == NULL)
+    return -1;
+  Py_INCREF(interp->collectd_error);
+  PyModule_AddObject(module, "CollectdError",
+                     interp->collectd_error); /* Steals a reference. */
+  PyModule_AddIntConstant(module, "LOG_DEBUG", LOG_DEBUG);
+  PyModule_AddIntConstant(module, "LOG_INFO", LOG_INFO);
+  PyModule_AddIntConstant(module, "LOG_NOTICE", LOG_NOTICE);
+  PyModule_AddIntConstant(module, "LOG_WARNING", LOG_WARNING);
+  PyModule_AddIntConstant(module, "LOG_ERROR", LOG_ERR);
+  PyModule_AddIntConstant(module, "NOTIF_FAILURE", NOTIF_FAILURE);
+  PyModule_AddIntConstant(module, "NOTIF_WARNING", NOTIF_WARNING);
+  PyModule_AddIntConstant(module, "NOTIF_OKAY", NOTIF_OKAY);
+  PyModule_AddStringConstant(module, "DS_TYPE_COUNTER",
+                             DS_TYPE_TO_STRING(DS_TYPE_COUNTER));
+  PyModule_AddStringConstant(module, "DS_TYPE_GAUGE",
+                             DS_TYPE_TO_STRING(DS_TYPE_GAUGE));
+  PyModule_AddStringConstant(module, "DS_TYPE_DERIVE",
+                             DS_TYPE_TO_STRING(DS_TYPE_DERIVE));
+  PyModule_AddStringConstant(module, "DS_TYPE_ABSOLUTE",
+                             DS_TYPE_TO_STRING(DS_TYPE_ABSOLUTE));
+  return 0;
+}
+
 #ifdef IS_PY3K
+#ifdef CPY_SUBINTERPRETERS
+static PyModuleDef_Slot cpy_module_slots[] = {
+    {Py_mod_exec, cpy_module_exec},
+    {Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED},
+    {0, NULL}};
+
+static struct PyModuleDef collectdmodule = {
+    PyModuleDef_HEAD_INIT, "collectd",  /* name of module */
+    "The python interface to collectd", /* module documentation, may be NULL */
+    0, cpy_methods, cpy_module_slots};
+
+PyMODINIT_FUNC PyInit_collectd(void) {
+  return PyModuleDef_Init(&collectdmodule);
+}
+#else
 static struct PyModuleDef collectdmodule = {
     PyModuleDef_HEAD_INIT, "collectd",  /* name of module */
     "The python interface to collectd", /* module documentation, may be NULL */
     -1, cpy_methods};
 
 PyMODINIT_FUNC PyInit_collectd(void) {
-  return PyModule_Create(&collectdmodule);
+  PyObject *module = PyModule_Create(&collectdmodule);
+  if ((module != NULL) && (cpy_module_exec(module) != 0))
+    Py_CLEAR(module);
+  return module;
 }
 #endif
+#endif
 
 static int cpy_init_python(void) {
   PyOS_sighandler_t cur_sig;
-  PyObject *sys, *errordict;
+  PyObject *sys;
   PyObject *module;
 
 #ifdef IS_PY3K
@@ -1261,39 +2036,16 @@ static int cpy_init_python(void) {
   Py_Initialize();
   python_sigint_handler = PyOS_setsig(SIGINT, cur_sig);
 
-  if (PyType_Ready(&ConfigType) == -1) {
-    cpy_log_exception("python initialization: ConfigType");
-    return 1;
-  }
-  if (PyType_Ready(&PluginDataType) == -1) {
-    cpy_log_exception("python initialization: PluginDataType");
+#ifdef CPY_SUBINTERPRETERS
+  cpy_main_interp.name = "main";
+  cpy_main_interp.interp = PyInterpreterState_Get();
+  pthread_key_create(&cpy_tstate_key, cpy_tstate_destroy);
+  if (cpy_tstate_add(&cpy_main_interp, PyThreadState_Get()) != 0) {
+    ERROR("python plugin: calloc failed.");
     return 1;
   }
-  ValuesType.tp_base = &PluginDataType;
-  if (PyType_Ready(&ValuesType) == -1) {
-    cpy_log_exception("python initialization: ValuesType");
-    return 1;
-  }
-  NotificationType.tp_base = &PluginDataType;
-  if (PyType_Ready(&NotificationType) == -1) {
-    cpy_log_exception("python initialization: NotificationType");
-    return 1;
-  }
-  SignedType.tp_base = &PyLong_Type;
-  if (PyType_Ready(&SignedType) == -1) {
-    cpy_log_exception("python initialization: SignedType");
-    return 1;
-  }
-  UnsignedType.tp_base = &PyLong_Type;
-  if (PyType_Ready(&UnsignedType) == -1) {
-    cpy_log_exception("python initialization: UnsignedType");
-    return 1;
-  }
-  errordict = PyDict_New();
-  PyDict_SetItemString(
-      errordict, "__doc__",
-      cpy_string_to_unicode_or_bytes(CollectdError_doc)); /* New reference. */
-  CollectdError = PyErr_NewException("collectd.CollectdError", NULL, errordict);
+#endif
+
   sys = PyImport_ImportModule("sys"); /* New reference. */
   if (sys == NULL) {
     cpy_log_exception("python initialization");
@@ -1309,44 +2061,184 @@ static int cpy_init_python(void) {
   PyList_SetSlice(sys_path, 0, 1, NULL);
 
 #ifdef IS_PY3K
-  module = PyImport_ImportModule("collectd");
+  module = PyImport_ImportModule("collectd"); /* New reference. */
 #else
   module = Py_InitModule("collectd", cpy_methods); /* Borrowed reference. */
+  if ((module != NULL) && (cpy_module_exec(module) != 0))
+    module = NULL;
+#endif
+  if (module == NULL) {
+    cpy_log_exception("python initialization");
+    return 1;
+  }
+#ifdef IS_PY3K
+  Py_DECREF(module);
 #endif
-  PyModule_AddObject(module, "Config",
-                     (void *)&ConfigType); /* Steals a reference. */
-  PyModule_AddObject(module, "Values",
-                     (void *)&ValuesType); /* Steals a reference. */
-  PyModule_AddObject(module, "Notification",
-                     (void *)&NotificationType); /* Steals a reference. */
-  PyModule_AddObject(module, "Signed",
-                     (void *)&SignedType); /* Steals a reference. */
-  PyModule_AddObject(module, "Unsigned",
-                     (void *)&UnsignedType); /* Steals a reference. */
-  Py_XINCREF(CollectdError);
-  PyModule_AddObject(module, "CollectdError",
-                     CollectdError); /* Steals a reference. */
-  PyModule_AddIntConstant(module, "LOG_DEBUG", LOG_DEBUG);
-  PyModule_AddIntConstant(module, "LOG_INFO", LOG_INFO);
-  PyModule_AddIntConstant(module, "LOG_NOTICE", LOG_NOTICE);
-  PyModule_AddIntConstant(module, "LOG_WARNING", LOG_WARNING);
-  PyModule_AddIntConstant(module, "LOG_ERROR", LOG_ERR);
-  PyModule_AddIntConstant(module, "NOTIF_FAILURE", NOTIF_FAILURE);
-  PyModule_AddIntConstant(module, "NOTIF_WARNING", NOTIF_WARNING);
-  PyModule_AddIntConstant(module, "NOTIF_OKAY", NOTIF_OKAY);
-  PyModule_AddStringConstant(module, "DS_TYPE_COUNTER",
-                             DS_TYPE_TO_STRING(DS_TYPE_COUNTER));
-  PyModule_AddStringConstant(module, "DS_TYPE_GAUGE",
-                             DS_TYPE_TO_STRING(DS_TYPE_GAUGE));
-  PyModule_AddStringConstant(module, "DS_TYPE_DERIVE",
-                             DS_TYPE_TO_STRING(DS_TYPE_DERIVE));
-  PyModule_AddStringConstant(module, "DS_TYPE_ABSOLUTE",
-                             DS_TYPE_TO_STRING(DS_TYPE_ABSOLUTE));
   return 0;
 }
 
-static int cpy_config(oconfig_item_t *ci) {
+/* Enables or disables logging of stack traces in the interpreter. You must
+ * hold its GIL. */
+static int cpy_set_log_traces(cpy_interp_t *interp, bool log_traces) {
   PyObject *tb;
+
+  if (!log_traces) {
+    Py_CLEAR(interp->format_exception);
+    return 0;
+  }
+  if (interp->format_exception)
+    return 0;
+  tb = PyImport_ImportModule("traceback"); /* New reference. */
+  if (tb == NULL) {
+    cpy_log_exception("python initialization");
+    return -1;
+  }
+  interp->format_exception =
+      PyObject_GetAttrString(tb, "format_exception"); /* New reference. */
+  Py_DECREF(tb);
+  if (interp->format_exception == NULL) {
+    cpy_log_exception("python initialization");
+    return -1;
+  }
+  return 0;
+}
+
+/* You must hold the GIL of the interpreter "sys_path" belongs to. */
+static int cpy_prepend_module_path(PyObject *sys_path, const char *dir) {
+  PyObject *dir_object;
+  int status = 0;
+
+  dir_object = cpy_string_to_unicode_or_bytes(dir); /* New reference. */
+  if (dir_object == NULL) {
+    ERROR("python plugin: Unable to convert \"%s\" to "
+          "a python object.",
+          dir);
+    cpy_log_exception("python initialization");
+    return -1;
+  }
+  if (PyList_Insert(sys_path, 0, dir_object) != 0) {
+    ERROR("python plugin: Unable to prepend \"%s\" to "
+          "python module path.",
+          dir);
+    cpy_log_exception("python initialization");
+    status = -1;
+  }
+  Py_DECREF(dir_object);
+  return status;
+}
+
+#ifdef CPY_SUBINTERPRETERS
+/* Prepares a new interpreter like cpy_init_python() and cpy_config() did with
+ * the main one. You must hold its GIL. */
+static int cpy_interp_setup(cpy_interp_t *interp) {
+  PyObject *argv, *path, *module;
+
+  argv = Py_BuildValue("[s]", ""); /* New reference. */
+  if ((argv == NULL) || (PySys_SetObject("argv", argv) != 0)) {
+    Py_XDECREF(argv);
+    cpy_log_exception("python initialization");
+    return -1;
+  }
+  Py_DECREF(argv);
+
+  path = PySys_GetObject("path"); /* Borrowed reference. */
+  if (path == NULL) {
+    ERROR("python plugin: sys.path is missing in interpreter \"%s\".",
+          interp->name);
+    return -1;
+  }
+  for (size_t i = 0; i < cpy_module_paths_num; i++)
+    if (cpy_prepend_module_path(path, cpy_module_paths[i]) != 0)
+      return -1;
+
+  if (cpy_set_log_traces(interp, cpy_log_traces) != 0)
+    return -1;
+
+  module = PyImport_ImportModule("collectd"); /* New reference. */
+  if (module == NULL) {
+    cpy_log_exception("python initialization");
+    return -1;
+  }
+  Py_DECREF(module);
+  return 0;
+}
+
+/* Creates an interpreter with its own GIL for the module "name". You must hold
+ * the GIL of the main interpreter. */
+static cpy_interp_t *cpy_interp_new(const char *name) {
+  PyThreadState *main_tstate = PyThreadState_Get();
+  PyThreadState *tstate = NULL;
+  PyInterpreterConfig config = {
+      .use_main_obmalloc = 0,
+      .allow_fork = 0,
+      .allow_exec = 0,
+      .allow_threads = 1,
+      .allow_daemon_threads = 0,
+      .check_multi_interp_extensions = 1,
+      .gil = PyInterpreterConfig_OWN_GIL,
+  };
+  cpy_interp_t *interp;
+  PyStatus status;
+
+  interp = calloc(1, sizeof(*interp));
+  if (interp == NULL) {
+    ERROR("python plugin: calloc failed.");
+    return NULL;
+  }
+  interp->name = strdup(name);
+  if (interp->name == NULL) {
+    ERROR("python plugin: strdup failed.");
+    free(interp);
+    return NULL;
+  }
+
+  status = Py_NewInterpreterFromConfig(&tstate, &config);
+  if (PyStatus_Exception(status)) {
+    ERROR("python plugin: Creating an interpreter for \"%s\" failed: %s",
+          name, (status.err_msg != NULL) ? status.err_msg : "unknown error");
+    if (CPY_TSTATE_GET_UNCHECKED() != main_tstate)
+      PyEval_RestoreThread(main_tstate);
+    free(interp->name);
+    free(interp);
+    return NULL;
+  }
+  interp->interp = PyThreadState_GetInterpreter(tstate);
+  interp->tstate = tstate;
+  /* Add it before importing the collectd module, which looks it up. If the
+   * setup fails, cpy_finalize() still ends the interpreter. */
+  interp->next = cpy_subinterpreters;
+  cpy_subinterpreters = interp;
+
+  /* Keep using this thread state in this thread: the "threading" module
+   * expects the thread that imported it to live as long as the
+   * interpreter. */
+  int err = cpy_tstate_add(interp, tstate);
+  if (err == 0)
+    err = cpy_interp_setup(interp);
+
+  PyEval_SaveThread();
+  PyEval_RestoreThread(main_tstate);
+  return (err == 0) ? interp : NULL;
+}
+#endif
+
+static int cpy_import(cpy_interp_t *interp, const char *module_name) {
+  PyObject *module;
+  int status = 0;
+
+  CPY_LOCK_THREADS(interp)
+  module = PyImport_ImportModule(module_name); /* New reference. */
+  if (module == NULL) {
+    ERROR("python plugin: Error importing module \"%s\".", module_name);
+    cpy_log_exception("importing module");
+    status = 1;
+  }
+  Py_XDECREF(module);
+  CPY_RELEASE_THREADS
+  return status;
+}
+
+static int cpy_config(oconfig_item_t *ci) {
   int status = 0;
 
   /* Ok in theory we shouldn't do initialization at this point
@@ -1393,69 +2285,61 @@ static int cpy_config(oconfig_item_t *ci) {
         status = 1;
         continue;
       }
-      if (!log_traces) {
-        Py_XDECREF(cpy_format_exception);
-        cpy_format_exception = NULL;
-        continue;
-      }
-      if (cpy_format_exception)
-        continue;
-      tb = PyImport_ImportModule("traceback"); /* New reference. */
-      if (tb == NULL) {
-        cpy_log_exception("python initialization");
+      if (cpy_set_log_traces(&cpy_main_interp, log_traces) != 0)
         status = 1;
-        continue;
+#ifdef CPY_SUBINTERPRETERS
+      cpy_log_traces = log_traces;
+      for (cpy_interp_t *i = cpy_subinterpreters; i != NULL; i = i->next) {
+        CPY_LOCK_THREADS(i)
+        if (cpy_set_log_traces(i, log_traces) != 0)
+          status = 1;
+        CPY_RELEASE_THREADS
       }
-      cpy_format_exception =
-          PyObject_GetAttrString(tb, "format_exception"); /* New reference. */
-      Py_DECREF(tb);
-      if (cpy_format_exception == NULL) {
-        cpy_log_exception("python initialization");
+#endif
+    } else if (strcasecmp(item->key, "SubInterpreters") == 0) {
+      bool enable;
+      if (cf_util_get_boolean(item, &enable) != 0) {
         status = 1;
+        continue;
       }
+#ifdef CPY_SUBINTERPRETERS
+      cpy_use_subinterpreters = enable;
+#else
+      if (enable)
+        WARNING("python plugin: \"SubInterpreters\" requires Python 3.12 or "
+                "later. All modules will share one interpreter.");
+#endif
     } else if (strcasecmp(item->key, "ModulePath") == 0) {
       char *dir = NULL;
-      PyObject *dir_object;
 
       if (cf_util_get_string(item, &dir) != 0) {
         status = 1;
         continue;
       }
-      dir_object = cpy_string_to_unicode_or_bytes(dir); /* New reference. */
-      if (dir_object == NULL) {
-        ERROR("python plugin: Unable to convert \"%s\" to "
-              "a python object.",
-              dir);
-        free(dir);
-        cpy_log_exception("python initialization");
+      if (cpy_prepend_module_path(sys_path, dir) != 0)
         status = 1;
-        continue;
-      }
-      if (PyList_Insert(sys_path, 0, dir_object) != 0) {
-        ERROR("python plugin: Unable to prepend \"%s\" to "
-              "python module path.",
-              dir);
-        cpy_log_exception("python initialization");
+#ifdef CPY_SUBINTERPRETERS
+      if (strarray_add(&cpy_module_paths, &cpy_module_paths_num, dir) != 0) {
+        ERROR("python plugin: strarray_add failed.");
         status = 1;
       }
-      Py_DECREF(dir_object);
+#endif
       free(dir);
     } else if (strcasecmp(item->key, "Import") == 0) {
       char *module_name = NULL;
-      PyObject *module;
+      cpy_interp_t *interp = &cpy_main_interp;
 
       if (cf_util_get_string(item, &module_name) != 0) {
         status = 1;
         continue;
       }
-      module = PyImport_ImportModule(module_name); /* New reference. */
-      if (module == NULL) {
-        ERROR("python plugin: Error importing module \"%s\".", module_name);
-        cpy_log_exception("importing module");
+#ifdef CPY_SUBINTERPRETERS
+      if (cpy_use_subinterpreters)
+        interp = cpy_interp_new(module_name);
+#endif
+      if ((interp == NULL) || (cpy_import(interp, module_name) != 0))
         status = 1;
-      }
       free(module_name);
-      Py_XDECREF(module);
     } else if (strcasecmp(item->key, "Module") == 0) {
       char *name = NULL;
       cpy_callback_t *c;
@@ -1478,6 +2362,7 @@ static int cpy_config(oconfig_item_t *ci) {
         continue;
       }
       free(name);
+      CPY_LOCK_THREADS(c->interp)
       if (c->data == NULL)
         ret = PyObject_CallFunction(
             c->callback, "N",
@@ -1491,6 +2376,7 @@ static int cpy_config(oconfig_item_t *ci) {
         status = 1;
       } else
         Py_DECREF(ret);
+      CPY_RELEASE_THREADS
     } else {
       ERROR("python plugin: Unknown config key \"%s\".", item->key);
       status = 1;
@@ -325,6 +325,28 @@ PyTypeObject PluginDataType = {
     PluginData_new                                    /* tp_new */
 };
 
+#ifdef CPY_SUBINTERPRETERS
+static void PluginData_dealloc(PyObject *self) {
+  PyTypeObject *type = Py_TYPE(self);
+  type->tp_free(self);
+  Py_DECREF(type);
+}
+
+static PyType_Slot PluginData_slots[] = {
+    {Py_tp_dealloc, PluginData_dealloc},
+    {Py_tp_repr, PluginData_repr},
+    {Py_tp_doc, PluginData_doc},
+    {Py_tp_members, PluginData_members},
+    {Py_tp_getset, PluginData_getseters},
+    {Py_tp_init, PluginData_init},
+    {Py_tp_new, PluginData_new},
+    {0, NULL}};
+
+PyType_Spec PluginDataSpec = {"collectd.PluginData", sizeof(PluginData), 0,
+                              Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+                              PluginData_slots};
+#endif
+
 static char interval_doc[] =
     "The interval is the timespan in seconds between two submits for\n"
     "the same data source. This value has to be a positive integer, so you "
@@ -505,12 +527,12 @@ static int cpy_build_meta_generic(PyObject *meta,
       meta_func->add_boolean(m, keystring, 0);
     } else if (PyFloat_Check(value)) {
       meta_func->add_double(m, keystring, PyFloat_AsDouble(value));
-    } else if (PyObject_TypeCheck(value, &SignedType)) {
+    } else if (PyObject_TypeCheck(value, CPY_TYPE(Signed))) {
       long long int lli;
       lli = PyLong_AsLongLong(value);
       if (!PyErr_Occurred() && (lli == (int64_t)lli))
         meta_func->add_signed_int(m, keystring, lli);
-    } else if (PyObject_TypeCheck(value, &UnsignedType)) {
+    } else if (PyObject_TypeCheck(value, CPY_TYPE(Unsigned))) {
       long long unsigned llu;
       llu = PyLong_AsUnsignedLongLong(value);
       if (!PyErr_Occurred() && (llu == (uint64_t)llu))
@@ -840,6 +862,251 @@ static PyObject *Values_write(Values *self, PyObject *args, PyObject *kwds) {
   Py_RETURN_NONE;
 }
 
+/* Reads element "i" of a buffer with the struct module format "format" into
+ * "value", converted for a data source of type "ds_type". Returns non-zero if
+ * the format is not supported. */
+static int cpy_buffer_get_value(const char *format, const void *buf, size_t i,
+                                int ds_type, value_t *value) {
+  double d = 0.0;
+  int64_t s = 0;
+  uint64_t u = 0;
+  bool is_float = false, is_signed = false;
+
+  /* only native byte order and alignment */
+  if (format[0] == '@')
+    format++;
+  if (format[0] == 0 || format[1] != 0)
+    return -1;
+
+#define CPY_BUFFER_CASE(c, ctype, var, flag)                                   \
+  case c:                                                                      \
+    var = ((const ctype *)buf)[i];                                             \
+    flag = true;                                                               \
+    break
+  switch (format[0]) {
+    CPY_BUFFER_CASE('d', double, d, is_float);
+    CPY_BUFFER_CASE('f', float, d, is_float);
+    CPY_BUFFER_CASE('b', signed char, s, is_signed);
+    CPY_BUFFER_CASE('h', short, s, is_signed);
+    CPY_BUFFER_CASE('i', int, s, is_signed);
+    CPY_BUFFER_CASE('l', long, s, is_signed);
+    CPY_BUFFER_CASE('q', long long, s, is_signed);
+  case 'B':
+    u = ((const unsigned char *)buf)[i];
+    break;
+  case 'H':
+    u = ((const unsigned short *)buf)[i];
+    break;
+  case 'I':
+    u = ((const unsigned int *)buf)[i];
+    break;
+  case 'L':
+    u = ((const unsigned long *)buf)[i];
+    break;
+  case 'Q':
+    u = ((const unsigned long long *)buf)[i];
+    break;
+  default:
+    return -1;
+  }
+#undef CPY_BUFFER_CASE
+
+  if (is_float) {
+    s = (int64_t)d;
+    u = (uint64_t)d;
+  } else if (is_signed) {
+    d = (double)s;
+    u = (uint64_t)s;
+  } else {
+    d = (double)u;
+    s = (int64_t)u;
+  }
+
+  switch (ds_type) {
+  case DS_TYPE_GAUGE:
+    value->gauge = d;
+    break;
+  case DS_TYPE_DERIVE:
+    value->derive = s;
+    break;
+  case DS_TYPE_COUNTER:
+    value->counter = u;
+    break;
+  case DS_TYPE_ABSOLUTE:
+    value->absolute = u;
+    break;
+  }
+  return 0;
+}
+
+/* Converts the Python number "item" for a data source of type "ds_type". */
+static int cpy_object_get_value(PyObject *item, int ds_type, value_t *value) {
+  switch (ds_type) {
+  case DS_TYPE_GAUGE:
+    value->gauge = PyFloat_AsDouble(item);
+    break;
+  case DS_TYPE_DERIVE:
+    value->derive = PyLong_AsLongLong(item);
+    break;
+  case DS_TYPE_COUNTER:
+    value->counter = PyLong_AsUnsignedLongLong(item);
+    break;
+  case DS_TYPE_ABSOLUTE:
+    value->absolute = PyLong_AsUnsignedLongLong(item);
+    break;
+  }
+  return (PyErr_Occurred() != NULL) ? -1 : 0;
+}
+
+PyObject *cpy_dispatch_many(PyObject *self, PyObject *args, PyObject *kwds) {
+  Values *template;
+  PyObject *type_instances, *values;
+  PyObject *names_seq = NULL, *values_seq = NULL;
+  Py_buffer view = {0};
+  bool have_view = false;
+  char const **names = NULL;
+  value_t *vals = NULL;
+  value_list_t value_list = VALUE_LIST_INIT;
+  PyObject *result = NULL;
+  int ret;
+
+  static char *kwlist[] = {"template", "type_instances", "values", NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!OO", kwlist, CPY_TYPE(Values),
+                                   &template, &type_instances, &values))
+    return NULL;
+
+  if (template->data.type[0] == 0) {
+    PyErr_SetString(PyExc_RuntimeError, "type not set");
+    return NULL;
+  }
+  const data_set_t *ds = plugin_get_ds(template->data.type);
+  if (ds == NULL) {
+    PyErr_Format(PyExc_TypeError, "Dataset %s not found", template->data.type);
+    return NULL;
+  }
+  if (template->meta != NULL && template->meta != Py_None &&
+      !PyDict_Check(template->meta)) {
+    PyErr_Format(PyExc_TypeError, "meta must be a dict");
+    return NULL;
+  }
+
+  names_seq = PySequence_Fast(type_instances,
+                              "type_instances must be a sequence of strings");
+  if (names_seq == NULL)
+    return NULL;
+  size_t num = (size_t)PySequence_Fast_GET_SIZE(names_seq);
+  size_t values_num = num * ds->ds_num;
+
+  names = calloc(num + 1, sizeof(*names));
+  vals = calloc(values_num + 1, sizeof(*vals));
+  if (names == NULL || vals == NULL) {
+    PyErr_NoMemory();
+    goto out;
+  }
+
+  /* Borrowed buffers, valid as long as names_seq holds the strings. */
+  for (size_t i = 0; i < num; i++) {
+    PyObject *item = PySequence_Fast_GET_ITEM(names_seq, i);
+#ifdef IS_PY3K
+    if (PyUnicode_Check(item))
+      names[i] = PyUnicode_AsUTF8(item);
+    else if (PyBytes_Check(item))
+      names[i] = PyBytes_AsString(item);
+#else
+    if (PyString_Check(item))
+      names[i] = PyString_AsString(item);
+#endif
+    if (names[i] == NULL) {
+      if (PyErr_Occurred() == NULL)
+        PyErr_SetString(PyExc_TypeError,
+                        "type_instances must be a sequence of strings");
+      goto out;
+    }
+  }
+
+  /* Objects supporting the buffer protocol (array.array, numpy arrays, ...)
+   * are read directly, anything else is treated as a sequence of numbers. */
+  if (PyObject_CheckBuffer(values)) {
+    if (PyObject_GetBuffer(values, &view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) !=
+        0)
+      goto out;
+    have_view = true;
+
+    const char *format = (view.format != NULL) ? view.format : "B";
+    if ((size_t)(view.len / view.itemsize) != values_num) {
+      PyErr_Format(PyExc_RuntimeError,
+                   "type %s needs %" PRIsz " values for %" PRIsz
+                   " type instances, got %" PRIsz,
+                   template->data.type, values_num, num,
+                   (size_t)(view.len / view.itemsize));
+      goto out;
+    }
+    for (size_t i = 0; i < values_num; i++) {
+      if (cpy_buffer_get_value(format, view.buf, i,
+                               ds->ds[i % ds->ds_num].type, vals + i) != 0) {
+        PyErr_Format(PyExc_TypeError, "unsupported buffer format '%s'",
+                     format);
+        goto out;
+      }
+    }
+  } else {
+    values_seq = PySequence_Fast(values, "values must be a sequence or "
+                                         "support the buffer protocol");
+    if (values_seq == NULL)
+      goto out;
+    if ((size_t)PySequence_Fast_GET_SIZE(values_seq) != values_num) {
+      PyErr_Format(PyExc_RuntimeError,
+                   "type %s needs %" PRIsz " values for %" PRIsz
+                   " type instances, got %" PRIsz,
+                   template->data.type, values_num, num,
+                   (size_t)PySequence_Fast_GET_SIZE(values_seq));
+      goto out;
+    }
+    for (size_t i = 0; i < values_num; i++) {
+      if (cpy_object_get_value(PySequence_Fast_GET_ITEM(values_seq, i),
+                               ds->ds[i % ds->ds_num].type, vals + i) != 0)
+        goto out;
+    }
+  }
+
+  sstrncpy(value_list.host, template->data.host, sizeof(value_list.host));
+  sstrncpy(value_list.plugin, template->data.plugin,
+           sizeof(value_list.plugin));
+  sstrncpy(value_list.plugin_instance, template->data.plugin_instance,
+           sizeof(value_list.plugin_instance));
+  sstrncpy(value_list.type, template->data.type, sizeof(value_list.type));
+  if (value_list.host[0] == 0)
+    sstrncpy(value_list.host, hostname_g, sizeof(value_list.host));
+  if (value_list.plugin[0] == 0)
+    sstrncpy(value_list.plugin, "python", sizeof(value_list.plugin));
+  value_list.values_len = ds->ds_num;
+  value_list.time = DOUBLE_TO_CDTIME_T(template->data.time);
+  value_list.interval = DOUBLE_TO_CDTIME_T(template->interval);
+  value_list.meta = cpy_build_meta(template->meta);
+
+  Py_BEGIN_ALLOW_THREADS;
+  ret = plugin_dispatch_values_bulk(&value_list, names, vals, num);
+  Py_END_ALLOW_THREADS;
+  meta_data_destroy(value_list.meta);
+  if (ret != 0) {
+    PyErr_SetString(PyExc_RuntimeError,
+                    "error dispatching values, read the logs");
+    goto out;
+  }
+
+  result = Py_None;
+  Py_INCREF(result);
+
+out:
+  if (have_view)
+    PyBuffer_Release(&view);
+  Py_XDECREF(values_seq);
+  Py_XDECREF(names_seq);
+  free(names);
+  free(vals);
+  return result;
+}
+
 static PyObject *Values_repr(PyObject *s) {
   PyObject *ret, *tmp;
   static PyObject *l_interval, *l_values, *l_meta, *l_closing;
@@ -883,6 +1150,7 @@ static PyObject *Values_repr(PyObject *s) {
 
 static int Values_traverse(PyObject *self, visitproc visit, void *arg) {
   Values *v = (Values *)self;
+  CPY_HEAP_TYPE_VISIT(self);
   Py_VISIT(v->values);
   Py_VISIT(v->meta);
   return 0;
@@ -896,8 +1164,11 @@ static int Values_clear(PyObject *self) {
 }
 
 static void Values_dealloc(PyObject *self) {
+  PyTypeObject *type = Py_TYPE(self);
+  PyObject_GC_UnTrack(self);
   Values_clear(self);
-  self->ob_type->tp_free(self);
+  type->tp_free(self);
+  CPY_HEAP_TYPE_DECREF(type);
 }
 
 static PyMemberDef Values_members[] = {
@@ -953,6 +1224,24 @@ PyTypeObject ValuesType = {
     Values_new       /* tp_new */
 };
 
+#ifdef CPY_SUBINTERPRETERS
+static PyType_Slot Values_slots[] = {{Py_tp_dealloc, Values_dealloc},
+                                     {Py_tp_repr, Values_repr},
+                                     {Py_tp_doc, Values_doc},
+                                     {Py_tp_traverse, Values_traverse},
+                                     {Py_tp_clear, Values_clear},
+                                     {Py_tp_methods, Values_methods},
+                                     {Py_tp_members, Values_members},
+                                     {Py_tp_init, Values_init},
+                                     {Py_tp_new, Values_new},
+                                     {0, NULL}};
+
+PyType_Spec ValuesSpec = {"collectd.Values", sizeof(Values), 0,
+                          Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE |
+                              Py_TPFLAGS_HAVE_GC,
+                          Values_slots};
+#endif
+
 static char notification_meta_doc[] =
     "These are the meta data for the Notification object.\n"
     "It has to be a dictionary of numbers, strings or bools. All keys must be\n"
@@ -1185,6 +1474,7 @@ static PyObject *Notification_repr(PyObject *s) {
 
 static int Notification_traverse(PyObject *self, visitproc visit, void *arg) {
   Notification *n = (Notification *)self;
+  CPY_HEAP_TYPE_VISIT(self);
   Py_VISIT(n->meta);
   return 0;
 }
@@ -1196,8 +1486,11 @@ static int Notification_clear(PyObject *self) {
 }
 
 static void Notification_dealloc(PyObject *self) {
+  PyTypeObject *type = Py_TYPE(self);
+  PyObject_GC_UnTrack(self);
   Notification_clear(self);
-  self->ob_type->tp_free(self);
+  type->tp_free(self);
+  CPY_HEAP_TYPE_DECREF(type);
 }
 
 static PyMethodDef Notification_methods[] = {
@@ -1256,6 +1549,27 @@ PyTypeObject NotificationType = {
     Notification_new        /* tp_new */
 };
 
+#ifdef CPY_SUBINTERPRETERS
+static PyType_Slot Notification_slots[] = {
+    {Py_tp_dealloc, Notification_dealloc},
+    {Py_tp_repr, Notification_repr},
+    {Py_tp_doc, Notification_doc},
+    {Py_tp_traverse, Notification_traverse},
+    {Py_tp_clear, Notification_clear},
+    {Py_tp_methods, Notification_methods},
+    {Py_tp_members, Notification_members},
+    {Py_tp_getset, Notification_getseters},
+    {Py_tp_init, Notification_init},
+    {Py_tp_new, Notification_new},
+    {0, NULL}};
+
+PyType_Spec NotificationSpec = {"collectd.Notification", sizeof(Notification),
+                                0,
+                                Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE |
+                                    Py_TPFLAGS_HAVE_GC,
+                                Notification_slots};
+#endif
+
 static char Signed_doc[] =
     "This is a long by another name. Use it in meta data dicts\n"
     "to choose the way it is stored in the meta data.";
@@ -1309,3 +1623,28 @@ PyTypeObject UnsignedType = {
     Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* tp_flags */
     Unsigned_doc                              /* tp_doc */
 };
+
+#ifdef CPY_SUBINTERPRETERS
+/* Signed and Unsigned add no members to int, so they inherit its size. */
+static void Long_dealloc(PyObject *self) {
+  PyTypeObject *type = Py_TYPE(self);
+  PyLong_Type.tp_dealloc(self);
+  Py_DECREF(type);
+}
+
+static PyType_Slot Signed_slots[] = {{Py_tp_dealloc, Long_dealloc},
+                                     {Py_tp_doc, Signed_doc},
+                                     {0, NULL}};
+
+PyType_Spec SignedSpec = {"collectd.Signed", 0, 0,
+                          Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+                          Signed_slots};
+
+static PyType_Slot Unsigned_slots[] = {{Py_tp_dealloc, Long_dealloc},
+                                       {Py_tp_doc, Unsigned_doc},
+                                       {0, NULL}};
+
+PyType_Spec UnsignedSpec = {"collectd.Unsigned", 0, 0,
+                            Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+                            Unsigned_slots};
+#endif
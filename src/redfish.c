@@ -31,13 +31,21 @@
 
 #include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
-#include "utils/deq/deq.h"
 #include "utils_llist.h"
 
-#include <redfish.h>
+#include <curl/curl.h>
+#include <jansson.h>
+
 #define PLUGIN_NAME "redfish"
 #define MAX_STR_LEN 128
 
+#define REDFISH_DEFAULT_MAX_HOST_CONNECTIONS 2
+#define REDFISH_SESSIONS_PATH "/redfish/v1/SessionService/Sessions"
+
+#if LIBCURL_VERSION_NUM >= 0x074400 /* 7.68.0 */
+#define HAVE_CURL_MULTI_WAKEUP 1
+#endif
+
 struct redfish_property_s {
   char *name;
   char *plugin_inst;
@@ -59,26 +67,65 @@ struct redfish_query_s {
 };
 typedef struct redfish_query_s redfish_query_t;
 
+struct redfish_service_s;
+typedef struct redfish_service_s redfish_service_t;
+
+/* A response being received. */
+struct redfish_buffer_s {
+  char *data;
+  size_t size;
+  size_t fill;
+};
+typedef struct redfish_buffer_s redfish_buffer_t;
+
+/* One query of one service. The easy handle is kept, so that the connection
+ * and the TLS session to the BMC are reused. The last payload is kept along
+ * with its ETag: when the BMC answers "304 Not Modified", it is processed
+ * again instead of being transferred and parsed again. */
+struct redfish_job_s {
+  redfish_service_t *service;
+  redfish_query_t *query;
+
+  CURL *curl;
+  char *url;
+  struct curl_slist *headers;
+  redfish_buffer_t response;
+  char *etag_new;
+  bool busy;
+
+  char *etag;
+  json_t *payload;
+
+  struct redfish_job_s *next;
+};
+typedef struct redfish_job_s redfish_job_t;
+
 struct redfish_service_s {
   char *name;
   char *host;
   char *user;
   char *passwd;
   char *token;
-  unsigned int flags;
+  bool session;
+  bool verify_peer;
+  bool verify_host;
+  char *cacert;
   char **queries;      /* List of queries */
   llist_t *query_ptrs; /* Pointers to query structs */
   size_t queries_num;
-  enumeratorAuthentication auth;
-  redfishService *redfish;
-};
-typedef struct redfish_service_s redfish_service_t;
 
-struct redfish_payload_ctx_s {
-  redfish_service_t *service;
-  redfish_query_t *query;
+  redfish_job_t *jobs;
+
+  /* Session login, if "Session" is enabled. */
+  CURL *login;
+  struct curl_slist *login_headers;
+  char *login_body;
+  redfish_buffer_t login_response;
+  bool login_busy;
+  bool cycle_pending;
+  char *session_token; /* X-Auth-Token */
+  char *session_uri;   /* Location of the session */
 };
-typedef struct redfish_payload_ctx_s redfish_payload_ctx_t;
 
 enum redfish_value_type_e { VAL_TYPE_STR = 0, VAL_TYPE_INT, VAL_TYPE_REAL };
 typedef enum redfish_value_type_e redfish_value_type_t;
@@ -90,23 +137,31 @@ union redfish_value_u {
 };
 typedef union redfish_value_u redfish_value_t;
 
-typedef struct redfish_job_s {
-  DEQ_LINKS(struct redfish_job_s);
-  redfish_payload_ctx_t *service_query;
-} redfish_job_t;
-
-DEQ_DECLARE(redfish_job_t, redfish_job_list_t);
-
 struct redfish_ctx_s {
   llist_t *services;
   c_avl_tree_t *queries;
+
+  long max_host_connections;
+  long timeout_ms;
+
+  /* All requests are run by one curl multi handle, in the worker thread. */
+  CURLM *multi;
+  CURLSH *share;
   pthread_t worker_thread;
-  redfish_job_list_t jobs;
+  bool worker_running;
+
+  pthread_mutex_t lock;
+  bool cycle_requested;
+  bool shutdown;
 };
 typedef struct redfish_ctx_s redfish_ctx_t;
 
 /* Globals */
-static redfish_ctx_t ctx;
+static redfish_ctx_t ctx = {
+    .max_host_connections = REDFISH_DEFAULT_MAX_HOST_CONNECTIONS,
+    .timeout_ms = -1,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
 
 static int redfish_cleanup(void);
 static int redfish_validate_config(void);
@@ -167,11 +222,37 @@ static void redfish_print_config(void) {
 }
 #endif
 
+/* The job must not be in the multi handle anymore. */
+static void redfish_job_destroy(redfish_job_t *job) {
+  if (job == NULL)
+    return;
+
+  if (job->curl != NULL)
+    curl_easy_cleanup(job->curl);
+  curl_slist_free_all(job->headers);
+  sfree(job->url);
+  sfree(job->response.data);
+  sfree(job->etag_new);
+  sfree(job->etag);
+  if (job->payload != NULL)
+    json_decref(job->payload);
+  sfree(job);
+}
+
 static void redfish_service_destroy(redfish_service_t *service) {
-  /* This is checked internally by cleanupServiceEnumerator() also,
-   * but as long as it's a third-party library let's be a little 'defensive' */
-  if (service->redfish != NULL)
-    cleanupServiceEnumerator(service->redfish);
+  while (service->jobs != NULL) {
+    redfish_job_t *next = service->jobs->next;
+    redfish_job_destroy(service->jobs);
+    service->jobs = next;
+  }
+
+  if (service->login != NULL)
+    curl_easy_cleanup(service->login);
+  curl_slist_free_all(service->login_headers);
+  sfree(service->login_body);
+  sfree(service->login_response.data);
+  sfree(service->session_token);
+  sfree(service->session_uri);
 
   /* Destroy all service members, sfree() as well as strarray_free()
    * and llist_destroy() are safe to call on NULL argument */
@@ -180,15 +261,171 @@ static void redfish_service_destroy(redfish_service_t *service) {
   sfree(service->user);
   sfree(service->passwd);
   sfree(service->token);
+  sfree(service->cacert);
   strarray_free(service->queries, (size_t)service->queries_num);
   llist_destroy(service->query_ptrs);
 
   sfree(service);
 }
 
-static void redfish_job_destroy(redfish_job_t *job) {
-  sfree(job->service_query);
-  sfree(job);
+static size_t redfish_curl_write(void *buf, size_t size, size_t nmemb,
+                                 void *user_data) {
+  redfish_buffer_t *b = user_data;
+  size_t len = size * nmemb;
+
+  if ((b->fill + len + 1) > b->size) {
+    size_t new_size = (b->size == 0) ? 4096 : b->size;
+    while ((b->fill + len + 1) > new_size)
+      new_size *= 2;
+    char *tmp = realloc(b->data, new_size);
+    if (tmp == NULL)
+      return 0;
+    b->data = tmp;
+    b->size = new_size;
+  }
+
+  memcpy(b->data + b->fill, buf, len);
+  b->fill += len;
+  b->data[b->fill] = 0;
+  return len;
+}
+
+/* Returns a copy of the value of header "name" if "line" is that header. */
+static char *redfish_header_value(char const *line, size_t len,
+                                  char const *name) {
+  size_t name_len = strlen(name);
+  if ((len <= name_len + 1) || (strncasecmp(line, name, name_len) != 0) ||
+      (line[name_len] != ':'))
+    return NULL;
+
+  char const *start = line + name_len + 1;
+  char const *end = line + len;
+  while ((start < end) && isspace((unsigned char)*start))
+    start++;
+  while ((end > start) && isspace((unsigned char)end[-1]))
+    end--;
+
+  char *value = malloc((size_t)(end - start) + 1);
+  if (value == NULL)
+    return NULL;
+  memcpy(value, start, (size_t)(end - start));
+  value[end - start] = 0;
+  return value;
+}
+
+static size_t redfish_job_header(char *buf, size_t size, size_t nmemb,
+                                 void *user_data) {
+  redfish_job_t *job = user_data;
+  size_t len = size * nmemb;
+
+  char *etag = redfish_header_value(buf, len, "ETag");
+  if (etag != NULL) {
+    sfree(job->etag_new);
+    job->etag_new = etag;
+  }
+  return len;
+}
+
+static size_t redfish_login_header(char *buf, size_t size, size_t nmemb,
+                                   void *user_data) {
+  redfish_service_t *service = user_data;
+  size_t len = size * nmemb;
+  char *value;
+
+  if ((value = redfish_header_value(buf, len, "X-Auth-Token")) != NULL) {
+    sfree(service->session_token);
+    service->session_token = value;
+  } else if ((value = redfish_header_value(buf, len, "Location")) != NULL) {
+    sfree(service->session_uri);
+    service->session_uri = value;
+  }
+  return len;
+}
+
+static void redfish_curl_setup(redfish_service_t *service, CURL *curl) {
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_USERAGENT, COLLECTD_USERAGENT);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, (long)service->verify_peer);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST,
+                   service->verify_host ? 2L : 0L);
+  if (service->cacert != NULL)
+    curl_easy_setopt(curl, CURLOPT_CAINFO, service->cacert);
+  if (ctx.share != NULL)
+    curl_easy_setopt(curl, CURLOPT_SHARE, ctx.share);
+
+  long timeout_ms = ctx.timeout_ms;
+  if (timeout_ms < 0)
+    timeout_ms = (long)CDTIME_T_TO_MS(plugin_get_interval());
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeout_ms);
+}
+
+static redfish_job_t *redfish_job_create(redfish_service_t *service,
+                                         redfish_query_t *query) {
+  redfish_job_t *job = calloc(1, sizeof(*job));
+  if (job == NULL)
+    return NULL;
+
+  job->service = service;
+  job->query = query;
+
+  size_t url_len = strlen(service->host) + strlen(query->endpoint) + 1;
+  job->url = malloc(url_len);
+  job->curl = curl_easy_init();
+  if ((job->url == NULL) || (job->curl == NULL)) {
+    redfish_job_destroy(job);
+    return NULL;
+  }
+  ssnprintf(job->url, url_len, "%s%s", service->host, query->endpoint);
+
+  redfish_curl_setup(service, job->curl);
+  curl_easy_setopt(job->curl, CURLOPT_URL, job->url);
+  curl_easy_setopt(job->curl, CURLOPT_PRIVATE, job);
+  curl_easy_setopt(job->curl, CURLOPT_WRITEFUNCTION, redfish_curl_write);
+  curl_easy_setopt(job->curl, CURLOPT_WRITEDATA, &job->response);
+  curl_easy_setopt(job->curl, CURLOPT_HEADERFUNCTION, redfish_job_header);
+  curl_easy_setopt(job->curl, CURLOPT_HEADERDATA, job);
+
+  if (service->user != NULL && !service->session) {
+    curl_easy_setopt(job->curl, CURLOPT_HTTPAUTH, CURLAUTH_BASIC);
+    curl_easy_setopt(job->curl, CURLOPT_USERNAME, service->user);
+    curl_easy_setopt(job->curl, CURLOPT_PASSWORD, service->passwd);
+  }
+
+  return job;
+}
+
+/* Prepares the login request of the Redfish SessionService. */
+static int redfish_login_create(redfish_service_t *service) {
+  json_t *body = json_pack("{s:s, s:s}", "UserName", service->user,
+                           "Password", service->passwd);
+  if (body == NULL)
+    return -ENOMEM;
+  service->login_body = json_dumps(body, JSON_COMPACT);
+  json_decref(body);
+
+  size_t url_len = strlen(service->host) + strlen(REDFISH_SESSIONS_PATH) + 1;
+  char url[url_len];
+  ssnprintf(url, url_len, "%s%s", service->host, REDFISH_SESSIONS_PATH);
+
+  service->login_headers =
+      curl_slist_append(NULL, "Content-Type: application/json");
+  service->login = curl_easy_init();
+  if ((service->login_body == NULL) || (service->login_headers == NULL) ||
+      (service->login == NULL))
+    return -ENOMEM;
+
+  redfish_curl_setup(service, service->login);
+  curl_easy_setopt(service->login, CURLOPT_URL, url);
+  curl_easy_setopt(service->login, CURLOPT_HTTPHEADER, service->login_headers);
+  curl_easy_setopt(service->login, CURLOPT_POSTFIELDS, service->login_body);
+  curl_easy_setopt(service->login, CURLOPT_PRIVATE, NULL);
+  curl_easy_setopt(service->login, CURLOPT_WRITEFUNCTION, redfish_curl_write);
+  curl_easy_setopt(service->login, CURLOPT_WRITEDATA,
+                   &service->login_response);
+  curl_easy_setopt(service->login, CURLOPT_HEADERFUNCTION,
+                   redfish_login_header);
+  curl_easy_setopt(service->login, CURLOPT_HEADERDATA, service);
+  return 0;
 }
 
 static int redfish_init(void) {
@@ -202,39 +439,34 @@ static int redfish_init(void) {
     return ret;
   }
 
-  DEQ_INIT(ctx.jobs);
-  ret = pthread_create(&ctx.worker_thread, NULL, redfish_worker_thread, NULL);
+  curl_global_init(CURL_GLOBAL_SSL);
 
-  if (ret != 0) {
-    ERROR(PLUGIN_NAME ": Creation of thread failed");
-    return ret;
+  ctx.multi = curl_multi_init();
+  if (ctx.multi == NULL) {
+    ERROR(PLUGIN_NAME ": curl_multi_init failed");
+    return -ENOMEM;
   }
+  curl_multi_setopt(ctx.multi, CURLMOPT_MAX_HOST_CONNECTIONS,
+                    ctx.max_host_connections);
+
+  /* Only the worker thread uses the handles, so the share needs no locks. */
+  ctx.share = curl_share_init();
+  if (ctx.share != NULL)
+    curl_share_setopt(ctx.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
 
   for (llentry_t *le = llist_head(ctx.services); le != NULL; le = le->next) {
     redfish_service_t *service = (redfish_service_t *)le->value;
-    /* Ignore redfish version */
-    service->flags |= REDFISH_FLAG_SERVICE_NO_VERSION_DOC;
-
-    /* Preparing struct for authentication */
-    if (service->user && service->passwd) {
-      service->auth.authCodes.userPass.username = service->user;
-      service->auth.authCodes.userPass.password = service->passwd;
-      service->redfish = createServiceEnumerator(
-          service->host, NULL, &service->auth, service->flags);
-    } else if (service->token) {
-      service->auth.authCodes.authToken.token = service->token;
-      service->auth.authType = REDFISH_AUTH_BEARER_TOKEN;
-      service->redfish = createServiceEnumerator(
-          service->host, NULL, &service->auth, service->flags);
-    } else {
-      service->redfish =
-          createServiceEnumerator(service->host, NULL, NULL, service->flags);
+
+    if (service->session && redfish_login_create(service) != 0) {
+      ERROR(PLUGIN_NAME ": Failed to prepare the login of service \"%s\"",
+            service->name);
+      return -ENOMEM;
     }
 
     service->query_ptrs = llist_create();
     if (service->query_ptrs == NULL) {
       ERROR(PLUGIN_NAME ": Failed to allocate memory for service query list");
-      goto error;
+      return -ENOMEM;
     }
 
     /* Preparing query pointers list for every service */
@@ -243,7 +475,7 @@ static int redfish_init(void) {
       if (c_avl_get(ctx.queries, (void *)service->queries[i], (void *)&ptr) !=
           0) {
         ERROR(PLUGIN_NAME ": Cannot find a service query in a context");
-        goto error;
+        return -EINVAL;
       }
 
       llentry_t *entry = llentry_create(ptr->name, ptr);
@@ -251,21 +483,30 @@ static int redfish_init(void) {
         llist_append(service->query_ptrs, entry);
       else {
         ERROR(PLUGIN_NAME ": Failed to allocate memory for a query list entry");
-        goto error;
+        return -ENOMEM;
       }
+
+      redfish_job_t *job = redfish_job_create(service, ptr);
+      if (job == NULL) {
+        ERROR(PLUGIN_NAME ": Failed to prepare query \"%s\" of service "
+                          "\"%s\"",
+              ptr->name, service->name);
+        return -ENOMEM;
+      }
+      job->next = service->jobs;
+      service->jobs = job;
     }
   }
 
-  return 0;
-
-error:
-  /* Freeing libredfish resources & llists */
-  for (llentry_t *le = llist_head(ctx.services); le != NULL; le = le->next) {
-    redfish_service_t *service = (redfish_service_t *)le->value;
-
-    redfish_service_destroy(service);
+  ret = plugin_thread_create(&ctx.worker_thread, redfish_worker_thread, NULL,
+                             "redfish");
+  if (ret != 0) {
+    ERROR(PLUGIN_NAME ": Creation of thread failed");
+    return ret;
   }
-  return -ENOMEM;
+  ctx.worker_running = true;
+
+  return 0;
 }
 
 static int redfish_preconfig(void) {
@@ -508,6 +749,14 @@ static int redfish_config_service(oconfig_item_t *cfg_item) {
       ret = cf_util_get_string(opt, &service->passwd);
     else if (strcasecmp("Token", opt->key) == 0)
       ret = cf_util_get_string(opt, &service->token);
+    else if (strcasecmp("Session", opt->key) == 0)
+      ret = cf_util_get_boolean(opt, &service->session);
+    else if (strcasecmp("VerifyPeer", opt->key) == 0)
+      ret = cf_util_get_boolean(opt, &service->verify_peer);
+    else if (strcasecmp("VerifyHost", opt->key) == 0)
+      ret = cf_util_get_boolean(opt, &service->verify_host);
+    else if (strcasecmp("CACert", opt->key) == 0)
+      ret = cf_util_get_string(opt, &service->cacert);
     else if (strcasecmp("Queries", opt->key) == 0) {
       ret = redfish_read_queries(opt, &service->queries);
       service->queries_num = opt->values_num;
@@ -553,7 +802,19 @@ static int redfish_config(oconfig_item_t *cfg_item) {
       ret = redfish_config_query(child, ctx.queries);
     else if (strcasecmp("Service", child->key) == 0)
       ret = redfish_config_service(child);
-    else {
+    else if (strcasecmp("MaxConnectionsPerHost", child->key) == 0) {
+      int tmp = 0;
+      ret = cf_util_get_int(child, &tmp);
+      if (ret == 0 && tmp < 1) {
+        ERROR(PLUGIN_NAME ": \"MaxConnectionsPerHost\" must be positive");
+        ret = -EINVAL;
+      }
+      ctx.max_host_connections = tmp;
+    } else if (strcasecmp("Timeout", child->key) == 0) {
+      int tmp = 0;
+      ret = cf_util_get_int(child, &tmp);
+      ctx.timeout_ms = tmp;
+    } else {
       ERROR(PLUGIN_NAME ": Invalid configuration option \"%s\".", child->key);
     }
 
@@ -592,6 +853,12 @@ static int redfish_validate_config(void) {
             service->name);
       return -EINVAL;
     }
+    if (service->session && service->user == NULL) {
+      ERROR(PLUGIN_NAME ": Service \"%s\" needs a user and password to "
+                        "open a session",
+            service->name);
+      return -EINVAL;
+    }
     if (service->queries_num == 0)
       WARNING(PLUGIN_NAME ": Service \"%s\" does not have queries",
               service->name);
@@ -816,27 +1083,11 @@ static void redfish_process_payload_property(const redfish_property_t *prop,
   }
 }
 
-static void redfish_process_payload(bool success, unsigned short http_code,
-                                    redfishPayload *payload, void *context) {
-  redfish_job_t *job = (redfish_job_t *)context;
-
-  if (!success) {
-    WARNING(PLUGIN_NAME ": Query has failed, HTTP code = %u\n", http_code);
-    goto free_job;
-  }
-
-  redfish_service_t *serv = job->service_query->service;
-
-  if (!payload) {
-    WARNING(PLUGIN_NAME ": Failed to get payload for service name \"%s\"",
-            serv->name);
-    goto free_job;
-  }
-
-  for (llentry_t *llres = llist_head(job->service_query->query->resources);
-       llres != NULL; llres = llres->next) {
+static void redfish_process_payload(redfish_job_t *job, json_t *payload) {
+  for (llentry_t *llres = llist_head(job->query->resources); llres != NULL;
+       llres = llres->next) {
     redfish_resource_t *res = (redfish_resource_t *)llres->value;
-    json_t *json_array = json_object_get(payload->json, res->name);
+    json_t *json_array = json_object_get(payload, res->name);
 
     if (json_array == NULL) {
       WARNING(PLUGIN_NAME ": Could not find resource \"%s\"", res->name);
@@ -847,95 +1098,302 @@ static void redfish_process_payload(bool success, unsigned short http_code,
          llprop = llprop->next) {
       redfish_property_t *prop = (redfish_property_t *)llprop->value;
 
-      redfish_process_payload_property(prop, json_array, res, serv);
+      redfish_process_payload_property(prop, json_array, res, job->service);
     }
   }
+}
 
-free_job:
-  cleanupPayload(payload);
-  redfish_job_destroy(job);
+static struct curl_slist *redfish_header_append(struct curl_slist *headers,
+                                                char const *name,
+                                                char const *value) {
+  char header[strlen(name) + strlen(value) + 3];
+  ssnprintf(header, sizeof(header), "%s: %s", name, value);
+  return curl_slist_append(headers, header);
 }
 
-static void *redfish_worker_thread(void __attribute__((unused)) * args) {
-  INFO(PLUGIN_NAME ": Worker is running");
+/* Starts the request of "job". Called by the worker thread only. */
+static void redfish_job_start(redfish_job_t *job) {
+  redfish_service_t *service = job->service;
+
+  curl_slist_free_all(job->headers);
+  job->headers = curl_slist_append(NULL, "Accept: application/json");
+  if (service->session && service->session_token != NULL)
+    job->headers = redfish_header_append(job->headers, "X-Auth-Token",
+                                         service->session_token);
+  else if (service->token != NULL) {
+    char value[strlen(service->token) + sizeof("Bearer ")];
+    ssnprintf(value, sizeof(value), "Bearer %s", service->token);
+    job->headers = redfish_header_append(job->headers, "Authorization", value);
+  }
+  if ((job->etag != NULL) && (job->payload != NULL))
+    job->headers =
+        redfish_header_append(job->headers, "If-None-Match", job->etag);
+  curl_easy_setopt(job->curl, CURLOPT_HTTPHEADER, job->headers);
+
+  job->response.fill = 0;
+  sfree(job->etag_new);
+
+  CURLMcode status = curl_multi_add_handle(ctx.multi, job->curl);
+  if (status != CURLM_OK) {
+    ERROR(PLUGIN_NAME ": Starting query \"%s\" of service \"%s\" failed: %s",
+          job->query->name, service->name, curl_multi_strerror(status));
+    return;
+  }
+  job->busy = true;
+}
 
-  for (;;) {
-    usleep(10);
+/* Starts the queries of "service" that are not still running. */
+static void redfish_service_start(redfish_service_t *service) {
+  if (service->session && service->session_token == NULL) {
+    /* The queries are started when the login has completed. */
+    service->cycle_pending = true;
+    if (service->login_busy)
+      return;
+
+    service->login_response.fill = 0;
+    if (curl_multi_add_handle(ctx.multi, service->login) == CURLM_OK)
+      service->login_busy = true;
+    return;
+  }
 
-    if (DEQ_IS_EMPTY(ctx.jobs))
+  service->cycle_pending = false;
+  for (redfish_job_t *job = service->jobs; job != NULL; job = job->next) {
+    if (job->busy) {
+      DEBUG(PLUGIN_NAME ": Query \"%s\" of service \"%s\" is still running",
+            job->query->name, service->name);
       continue;
+    }
+    redfish_job_start(job);
+  }
+}
+
+static void redfish_login_done(redfish_service_t *service, CURLcode result) {
+  long code = 0;
+  curl_easy_getinfo(service->login, CURLINFO_RESPONSE_CODE, &code);
+  service->login_busy = false;
+
+  if ((result != CURLE_OK) || (code < 200) || (code > 299) ||
+      (service->session_token == NULL)) {
+    WARNING(PLUGIN_NAME ": Opening a session with service \"%s\" failed, "
+                        "HTTP code = %ld: %s",
+            service->name, code,
+            (result != CURLE_OK) ? curl_easy_strerror(result) : "no token");
+    sfree(service->session_token);
+    service->cycle_pending = false;
+    return;
+  }
 
-    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+  DEBUG(PLUGIN_NAME ": Opened session %s with service \"%s\"",
+        (service->session_uri != NULL) ? service->session_uri : "(unknown)",
+        service->name);
+  if (service->cycle_pending)
+    redfish_service_start(service);
+}
 
-    redfish_job_t *job = DEQ_HEAD(ctx.jobs);
-    getPayloadByPathAsync(job->service_query->service->redfish,
-                          job->service_query->query->endpoint, NULL,
-                          redfish_process_payload, job);
-    DEQ_REMOVE_HEAD(ctx.jobs);
+static void redfish_job_done(redfish_job_t *job, CURLcode result) {
+  redfish_service_t *service = job->service;
+  long code = 0;
+  curl_easy_getinfo(job->curl, CURLINFO_RESPONSE_CODE, &code);
+  job->busy = false;
 
-    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+  if (result != CURLE_OK) {
+    WARNING(PLUGIN_NAME ": Query \"%s\" of service \"%s\" failed: %s",
+            job->query->name, service->name, curl_easy_strerror(result));
+    return;
   }
 
-  pthread_exit(NULL);
-  return NULL;
-}
+  if (code == 304 && job->payload != NULL) {
+    redfish_process_payload(job, job->payload);
+    return;
+  }
 
-static int redfish_read(__attribute__((unused)) user_data_t *ud) {
-  for (llentry_t *le = llist_head(ctx.services); le != NULL; le = le->next) {
-    redfish_service_t *service = (redfish_service_t *)le->value;
+  if ((code == 401) && service->session) {
+    /* The session has expired. Log in again with the next read. */
+    INFO(PLUGIN_NAME ": The session with service \"%s\" has expired",
+         service->name);
+    sfree(service->session_token);
+    sfree(service->session_uri);
+    return;
+  }
 
-    for (llentry_t *le = llist_head(service->query_ptrs); le != NULL;
-         le = le->next) {
-      redfish_query_t *query = (redfish_query_t *)le->value;
-      redfish_job_t *job = calloc(1, sizeof(*job));
+  if ((code < 200) || (code > 299)) {
+    WARNING(PLUGIN_NAME ": Query has failed, HTTP code = %ld", code);
+    return;
+  }
 
-      if (job == NULL) {
-        WARNING(PLUGIN_NAME ": Failed to allocate memory for task");
-        continue;
-      }
+  json_error_t error;
+  json_t *payload =
+      json_loadb(job->response.data, job->response.fill, 0, &error);
+  if (payload == NULL) {
+    WARNING(PLUGIN_NAME ": Failed to parse payload for service name \"%s\": "
+                        "%s",
+            service->name, error.text);
+    return;
+  }
+
+  if (job->payload != NULL)
+    json_decref(job->payload);
+  job->payload = payload;
+  sfree(job->etag);
+  job->etag = job->etag_new;
+  job->etag_new = NULL;
 
-      DEQ_ITEM_INIT(job);
+  redfish_process_payload(job, payload);
+}
 
-      redfish_payload_ctx_t *serv_res = calloc(1, sizeof(*serv_res));
+static void redfish_process_messages(void) {
+  CURLMsg *msg;
+  int remaining;
 
-      if (serv_res == NULL) {
-        WARNING(PLUGIN_NAME ": Failed to allocate memory for task's context");
-        sfree(job);
-        continue;
+  while ((msg = curl_multi_info_read(ctx.multi, &remaining)) != NULL) {
+    if (msg->msg != CURLMSG_DONE)
+      continue;
+
+    CURL *curl = msg->easy_handle;
+    CURLcode result = msg->data.result;
+    curl_multi_remove_handle(ctx.multi, curl);
+
+    redfish_job_t *job = NULL;
+    curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char **)&job);
+    if (job != NULL) {
+      redfish_job_done(job, result);
+      continue;
+    }
+
+    for (llentry_t *le = llist_head(ctx.services); le != NULL; le = le->next) {
+      redfish_service_t *service = le->value;
+      if (service->login == curl) {
+        redfish_login_done(service, result);
+        break;
       }
+    }
+  }
+}
 
-      serv_res->query = query;
-      serv_res->service = service;
-      job->service_query = serv_res;
+/* Runs all requests of all services concurrently. The read callback only
+ * asks for a new cycle, so a slow BMC delays neither the other BMCs nor the
+ * read thread. */
+static void *redfish_worker_thread(void __attribute__((unused)) * args) {
+  INFO(PLUGIN_NAME ": Worker is running");
 
-      DEQ_INSERT_TAIL(ctx.jobs, job);
+  pthread_mutex_lock(&ctx.lock);
+  while (!ctx.shutdown) {
+    bool cycle = ctx.cycle_requested;
+    ctx.cycle_requested = false;
+    pthread_mutex_unlock(&ctx.lock);
+
+    if (cycle) {
+      for (llentry_t *le = llist_head(ctx.services); le != NULL;
+           le = le->next)
+        redfish_service_start(le->value);
     }
+
+    int running = 0;
+    curl_multi_perform(ctx.multi, &running);
+    redfish_process_messages();
+
+#ifdef HAVE_CURL_MULTI_WAKEUP
+    curl_multi_poll(ctx.multi, NULL, 0, 1000, NULL);
+#else
+    curl_multi_wait(ctx.multi, NULL, 0, (running > 0) ? 1000 : 100, NULL);
+#endif
+
+    pthread_mutex_lock(&ctx.lock);
   }
+  pthread_mutex_unlock(&ctx.lock);
+
+  return NULL;
+}
+
+static int redfish_read(__attribute__((unused)) user_data_t *ud) {
+  pthread_mutex_lock(&ctx.lock);
+  ctx.cycle_requested = true;
+  pthread_mutex_unlock(&ctx.lock);
+
+#ifdef HAVE_CURL_MULTI_WAKEUP
+  curl_multi_wakeup(ctx.multi);
+#endif
   return 0;
 }
 
+/* Deletes the session, since BMCs only allow a few of them. */
+static void redfish_logout(redfish_service_t *service) {
+  if (service->session_token == NULL || service->session_uri == NULL)
+    return;
+
+  CURL *curl = curl_easy_init();
+  if (curl == NULL)
+    return;
+
+  char url[strlen(service->host) + strlen(service->session_uri) + 1];
+  if (strstr(service->session_uri, "://") != NULL)
+    sstrncpy(url, service->session_uri, sizeof(url));
+  else
+    ssnprintf(url, sizeof(url), "%s%s", service->host, service->session_uri);
+
+  struct curl_slist *headers =
+      redfish_header_append(NULL, "X-Auth-Token", service->session_token);
+
+  redfish_curl_setup(service, curl);
+  curl_easy_setopt(curl, CURLOPT_URL, url);
+  curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "DELETE");
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, redfish_curl_write);
+  redfish_buffer_t discard = {0};
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &discard);
+
+  CURLcode status = curl_easy_perform(curl);
+  if (status != CURLE_OK)
+    WARNING(PLUGIN_NAME ": Closing the session with service \"%s\" failed: "
+                        "%s",
+            service->name, curl_easy_strerror(status));
+
+  curl_easy_cleanup(curl);
+  curl_slist_free_all(headers);
+  sfree(discard.data);
+}
+
 static int redfish_cleanup(void) {
   INFO(PLUGIN_NAME ": Cleaning up");
   /* Shutting down a worker thread */
-  if (pthread_cancel(ctx.worker_thread) != 0)
-    ERROR(PLUGIN_NAME ": Failed to cancel the worker thread");
-
-  if (pthread_join(ctx.worker_thread, NULL) != 0)
-    ERROR(PLUGIN_NAME ": Failed to join the worker thread");
+  if (ctx.worker_running) {
+    pthread_mutex_lock(&ctx.lock);
+    ctx.shutdown = true;
+    pthread_mutex_unlock(&ctx.lock);
+#ifdef HAVE_CURL_MULTI_WAKEUP
+    curl_multi_wakeup(ctx.multi);
+#endif
 
-  /* Cleaning worker's queue */
-  while (!DEQ_IS_EMPTY(ctx.jobs)) {
-    redfish_job_t *job = DEQ_HEAD(ctx.jobs);
-    DEQ_REMOVE_HEAD(ctx.jobs);
-    redfish_job_destroy(job);
+    if (pthread_join(ctx.worker_thread, NULL) != 0)
+      ERROR(PLUGIN_NAME ": Failed to join the worker thread");
+    ctx.worker_running = false;
   }
 
   for (llentry_t *le = llist_head(ctx.services); le; le = le->next) {
     redfish_service_t *service = (redfish_service_t *)le->value;
 
+    if (ctx.multi != NULL) {
+      for (redfish_job_t *job = service->jobs; job != NULL; job = job->next)
+        if (job->busy)
+          curl_multi_remove_handle(ctx.multi, job->curl);
+      if (service->login_busy)
+        curl_multi_remove_handle(ctx.multi, service->login);
+    }
+    redfish_logout(service);
+
     redfish_service_destroy(service);
   }
   llist_destroy(ctx.services);
+  ctx.services = NULL;
+
+  if (ctx.multi != NULL) {
+    curl_multi_cleanup(ctx.multi);
+    ctx.multi = NULL;
+  }
+  if (ctx.share != NULL) {
+    curl_share_cleanup(ctx.share);
+    ctx.share = NULL;
+  }
 
   c_avl_iterator_t *i = c_avl_get_iterator(ctx.queries);
 
@@ -967,6 +1425,7 @@ static int redfish_cleanup(void) {
 
   c_avl_iterator_destroy(i);
   c_avl_destroy(ctx.queries);
+  ctx.queries = NULL;
 
   return 0;
 }
@@ -542,11 +542,14 @@ DEF_TEST(service_destroy) {
 
   service->query_ptrs = llist_create();
 
-  service->flags |= REDFISH_FLAG_SERVICE_NO_VERSION_DOC;
-  service->auth.authCodes.userPass.username = service->user;
-  service->auth.authCodes.userPass.password = service->passwd;
-  service->redfish = createServiceEnumerator(service->host, NULL,
-                                             &service->auth, service->flags);
+  service->session_token = strdup("SessionToken");
+  service->session_uri = strdup("/redfish/v1/SessionService/Sessions/1");
+
+  redfish_query_t query = {.name = "Query1", .endpoint = "/redfish/v1"};
+  service->jobs = redfish_job_create(service, &query);
+  CHECK_NOT_NULL(service->jobs);
+  EXPECT_EQ_STR("http://localhost:1234/redfish/v1", service->jobs->url);
+  service->jobs->etag = strdup("\"1\"");
 
   redfish_service_destroy(service);
   return 0;
@@ -559,6 +562,34 @@ DEF_TEST(job_destroy) {
   return 0;
 }
 
+DEF_TEST(header_value) {
+  struct {
+    char const *line;
+    char const *name;
+    char const *want;
+  } cases[] = {
+      {"ETag: \"abc\"\r\n", "ETag", "\"abc\""},
+      {"etag:W/\"1\"\r\n", "ETag", "W/\"1\""},
+      {"X-Auth-Token: 0123\r\n", "X-Auth-Token", "0123"},
+      {"ETagX: 1\r\n", "ETag", NULL},
+      {"Location: /s/1\r\n", "ETag", NULL},
+      {"ETag:\r\n", "ETag", ""},
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    char *got = redfish_header_value(cases[i].line, strlen(cases[i].line),
+                                     cases[i].name);
+    if (cases[i].want == NULL) {
+      EXPECT_EQ_PTR(NULL, got);
+      continue;
+    }
+    CHECK_NOT_NULL(got);
+    EXPECT_EQ_STR(cases[i].want, got);
+    sfree(got);
+  }
+  return 0;
+}
+
 DEF_TEST(json_get_string_1) {
   const char *json_text = "{ \"MemberId\": \"1234\" }";
 
@@ -610,6 +641,7 @@ int main(void) {
   RUN_TEST(process_payload_property);
   RUN_TEST(service_destroy);
   RUN_TEST(job_destroy);
+  RUN_TEST(header_value);
   RUN_TEST(json_get_string_1);
   RUN_TEST(json_get_string_2);
   END_TEST;
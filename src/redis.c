@@ -55,6 +55,8 @@ struct redis_query_s {
   char type[DATA_MAX_NAME_LEN];
   char instance[DATA_MAX_NAME_LEN];
   int database;
+  /* set while reading the replies if a SELECT was sent for this query */
+  bool select_sent;
 
   redis_query_t *next;
 };
@@ -77,6 +79,8 @@ struct redis_node_s {
   bool report_command_stats;
   bool report_cpu_usage;
   redisContext *redisContext;
+  /* database selected on the connection, -1 if unknown */
+  int database;
   redis_query_t *queries;
   prev_t prev;
 
@@ -359,6 +363,24 @@ static void *c_redisCommand(redis_node_t *rn, const char *format, ...) {
   return reply;
 } /* void c_redisCommand */
 
+/* Reads the next reply of a pipeline sent with redisAppendCommand(). */
+static redisReply *c_redisGetReply(redis_node_t *rn) {
+  redisContext *c = rn->redisContext;
+  void *reply = NULL;
+
+  if (c == NULL)
+    return NULL;
+
+  if ((redisGetReply(c, &reply) != REDIS_OK) || (reply == NULL)) {
+    ERROR("redis plugin: Connection error: %s", c->errstr);
+    redisFree(rn->redisContext);
+    rn->redisContext = NULL;
+    return NULL;
+  }
+
+  return reply;
+} /* redisReply *c_redisGetReply */
+
 static int redis_get_info_value(char const *info_line, char const *field_name,
                                 int ds_type, value_t *val) {
   char *str = strstr(info_line, field_name);
@@ -394,15 +416,17 @@ static int redis_handle_info(char *node, char const *info_line,
   return 0;
 } /* }}} int redis_handle_info */
 
-static int redis_handle_query(redis_node_t *rn, redis_query_t *rq) /* {{{ */
+/* Handles the reply "rr" to query "rq" and frees it. */
+static int redis_handle_query(redis_node_t *rn, redis_query_t *rq,
+                              redisReply *rr) /* {{{ */
 {
-  redisReply *rr;
   const data_set_t *ds;
   value_t val;
 
   ds = plugin_get_ds(rq->type);
   if (!ds) {
     ERROR("redis plugin: DS type `%s' not defined.", rq->type);
+    freeReplyObject(rr);
     return -1;
   }
 
@@ -410,17 +434,7 @@ static int redis_handle_query(redis_node_t *rn, redis_query_t *rq) /* {{{ */
     ERROR("redis plugin: DS type `%s' has too many datasources. This is not "
           "supported currently.",
           rq->type);
-    return -1;
-  }
-
-  if ((rr = c_redisCommand(rn, "SELECT %d", rq->database)) == NULL) {
-    WARNING("redis plugin: unable to switch to database `%d' on node `%s'.",
-            rq->database, rn->name);
-    return -1;
-  }
-
-  if ((rr = c_redisCommand(rn, rq->query)) == NULL) {
-    WARNING("redis plugin: unable to carry out query `%s'.", rq->query);
+    freeReplyObject(rr);
     return -1;
   }
 
@@ -618,6 +632,7 @@ static void redis_check_connection(redis_node_t *rn) {
   }
 
   rn->redisContext = rh;
+  rn->database = 0;
 
   if (rn->passwd) {
     redisReply *rr;
@@ -643,11 +658,12 @@ static void redis_check_connection(redis_node_t *rn) {
   return;
 } /* void redis_check_connection */
 
-static void redis_read_server_info(redis_node_t *rn) {
-  redisReply *rr;
-
-  if ((rr = c_redisCommand(rn, "INFO")) == NULL) {
-    WARNING("redis plugin: unable to get INFO from node `%s'.", rn->name);
+static void redis_read_server_info(redis_node_t *rn, redisReply *rr) {
+  if (rr->type != REDIS_REPLY_STRING) {
+    WARNING("redis plugin: node `%s' `INFO' returned unsupported "
+            "redis type %i.",
+            rn->name, rr->type);
+    freeReplyObject(rr);
     return;
   }
 
@@ -693,15 +709,7 @@ static void redis_read_server_info(redis_node_t *rn) {
   freeReplyObject(rr);
 } /* void redis_read_server_info */
 
-static void redis_read_command_stats(redis_node_t *rn) {
-  redisReply *rr;
-
-  if ((rr = c_redisCommand(rn, "INFO commandstats")) == NULL) {
-    WARNING("redis plugin: node `%s': unable to get `INFO commandstats'.",
-            rn->name);
-    return;
-  }
-
+static void redis_read_command_stats(redis_node_t *rn, redisReply *rr) {
   if (rr->type != REDIS_REPLY_STRING) {
     WARNING("redis plugin: node `%s' `INFO commandstats' returned unsupported "
             "redis type %i.",
@@ -787,22 +795,77 @@ static int redis_read(user_data_t *user_data) /* {{{ */
   if (!rn->redisContext) /* no connection */
     return -1;
 
-  redis_read_server_info(rn);
+  /* Send all commands at once and read the replies afterwards, so that a
+   * read costs a single round trip to the server. */
+  redisContext *c = rn->redisContext;
+  int status = redisAppendCommand(c, "INFO");
+  if ((status == REDIS_OK) && rn->report_command_stats)
+    status = redisAppendCommand(c, "INFO commandstats");
+
+  for (redis_query_t *rq = rn->queries; rq != NULL; rq = rq->next) {
+    rq->select_sent = false;
+    if (status != REDIS_OK)
+      break;
+
+    if (rq->database != rn->database) {
+      status = redisAppendCommand(c, "SELECT %d", rq->database);
+      rq->select_sent = true;
+      rn->database = rq->database;
+    }
+    if (status == REDIS_OK)
+      status = redisAppendCommand(c, rq->query);
+  }
+
+  if (status != REDIS_OK) {
+    ERROR("redis plugin: node `%s': unable to queue commands: %s", rn->name,
+          c->errstr);
+    redisFree(rn->redisContext);
+    rn->redisContext = NULL;
+    return -1;
+  }
 
-  if (!rn->redisContext) /* connection lost */
+  redisReply *rr;
+  if ((rr = c_redisGetReply(rn)) == NULL) { /* connection lost */
+    WARNING("redis plugin: unable to get INFO from node `%s'.", rn->name);
     return -1;
+  }
+  redis_read_server_info(rn, rr);
 
   if (rn->report_command_stats) {
-    redis_read_command_stats(rn);
-
-    if (!rn->redisContext) /* connection lost */
+    if ((rr = c_redisGetReply(rn)) == NULL) { /* connection lost */
+      WARNING("redis plugin: node `%s': unable to get `INFO commandstats'.",
+              rn->name);
       return -1;
+    }
+    redis_read_command_stats(rn, rr);
   }
 
+  bool database_ok = true;
   for (redis_query_t *rq = rn->queries; rq != NULL; rq = rq->next) {
-    redis_handle_query(rn, rq);
-    if (!rn->redisContext) /* connection lost */
+    if (rq->select_sent) {
+      if ((rr = c_redisGetReply(rn)) == NULL) /* connection lost */
+        return -1;
+
+      database_ok = (rr->type != REDIS_REPLY_ERROR);
+      if (!database_ok) {
+        WARNING("redis plugin: unable to switch to database `%d' on node "
+                "`%s': %s.",
+                rq->database, rn->name, rr->str);
+        rn->database = -1;
+      }
+      freeReplyObject(rr);
+    }
+
+    if ((rr = c_redisGetReply(rn)) == NULL) { /* connection lost */
+      WARNING("redis plugin: unable to carry out query `%s'.", rq->query);
       return -1;
+    }
+
+    /* The query ran in the wrong database if the last SELECT failed. */
+    if (database_ok)
+      redis_handle_query(rn, rq, rr);
+    else
+      freeReplyObject(rr);
   }
 
   return 0;
@@ -27,13 +27,21 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 #include "utils/rrdcreate/rrdcreate.h"
 
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
 #undef HAVE_CONFIG_H
 #include <rrd.h>
 #include <rrd_client.h>
 
+#define RC_DEFAULT_PORT "42217"
+#define RC_BATCH_IO_TIMEOUT 10 /* seconds */
+
 /*
  * Private variables
  */
@@ -49,7 +57,30 @@ static rrdcreate_config_t rrdcreate_config = {.stepsize = 0,
                                               .timespans_num = 0,
                                               .consolidation_functions = NULL,
                                               .consolidation_functions_num = 0,
-                                              .async = 0};
+                                              .async = 0,
+                                              .async_threads = 0,
+                                              .async_queue_length = 0,
+                                              .templates = false};
+
+/* Batch mode: updates are collected per file and sent to the daemon with the
+ * BATCH command over a connection of our own, because librrd's client has no
+ * batch interface. "batch" maps a file name to an rc_batch_entry_t and is
+ * protected by "batch_lock"; "batch_fd" is protected by "batch_conn_lock". */
+typedef struct {
+  char *values;
+  size_t len;
+  size_t size;
+} rc_batch_entry_t;
+
+static int batch_size;
+static cdtime_t batch_timeout = TIME_T_TO_CDTIME_T_STATIC(1);
+static c_avl_tree_t *batch;
+static size_t batch_values;
+static cdtime_t batch_start;
+static pthread_mutex_t batch_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int batch_fd = -1;
+static pthread_mutex_t batch_conn_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /*
  * Prototypes.
@@ -211,6 +242,14 @@ static int rc_config(oconfig_item_t *ci) {
       status = cf_util_get_boolean(child, &config_create_files);
     else if (strcasecmp("CreateFilesAsync", key) == 0)
       status = cf_util_get_boolean(child, &rrdcreate_config.async);
+    else if (strcasecmp("CreateThreads", key) == 0)
+      status =
+          rc_config_get_int_positive(child, &rrdcreate_config.async_threads);
+    else if (strcasecmp("CreateQueueLength", key) == 0)
+      status = rc_config_get_int_positive(child,
+                                          &rrdcreate_config.async_queue_length);
+    else if (strcasecmp("CreateFromTemplate", key) == 0)
+      status = cf_util_get_boolean(child, &rrdcreate_config.templates);
     else if (strcasecmp("CollectStatistics", key) == 0)
       status = cf_util_get_boolean(child, &config_collect_stats);
     else if (strcasecmp("StepSize", key) == 0) {
@@ -230,6 +269,10 @@ static int rc_config(oconfig_item_t *ci) {
         status = rc_config_add_timespan(tmp);
     } else if (strcasecmp("XFF", key) == 0)
       status = rc_config_get_xff(child, &rrdcreate_config.xff);
+    else if (strcasecmp("BatchSize", key) == 0)
+      status = rc_config_get_int_positive(child, &batch_size);
+    else if (strcasecmp("BatchTimeout", key) == 0)
+      status = cf_util_get_cdtime(child, &batch_timeout);
     else {
       WARNING("rrdcached plugin: Ignoring invalid option %s.", key);
       continue;
@@ -264,6 +307,342 @@ static int try_reconnect(void) {
   return 0;
 } /* int try_reconnect */
 
+/* Appends "len" bytes of "data" to a growing buffer. */
+static int rc_buffer_add(char **buffer, size_t *len, size_t *size, /* {{{ */
+                         char const *data, size_t data_len) {
+  if (*len + data_len + 1 > *size) {
+    size_t new_size = (*size == 0) ? 256 : *size;
+    while (*len + data_len + 1 > new_size)
+      new_size *= 2;
+
+    char *tmp = realloc(*buffer, new_size);
+    if (tmp == NULL)
+      return ENOMEM;
+    *buffer = tmp;
+    *size = new_size;
+  }
+
+  memcpy(*buffer + *len, data, data_len);
+  *len += data_len;
+  (*buffer)[*len] = 0;
+  return 0;
+} /* }}} int rc_buffer_add */
+
+static bool rc_address_is_unix(char const *addr) { /* {{{ */
+  return (strncmp("unix:", addr, strlen("unix:")) == 0) || (addr[0] == '/');
+} /* }}} bool rc_address_is_unix */
+
+static void rc_batch_disconnect(void) /* {{{ */
+{
+  if (batch_fd < 0)
+    return;
+
+  close(batch_fd);
+  batch_fd = -1;
+} /* }}} void rc_batch_disconnect */
+
+/* Opens the batch connection. Understands the same address formats as
+ * rrdc_connect(): "unix:/path", "/path" and "host[:port]". */
+static int rc_batch_connect(void) /* {{{ */
+{
+  struct timeval tv = {.tv_sec = RC_BATCH_IO_TIMEOUT};
+  int fd = -1;
+
+  if (batch_fd >= 0)
+    return 0;
+
+  if (rc_address_is_unix(daemon_address)) {
+    char const *path = daemon_address;
+    struct sockaddr_un sa = {.sun_family = AF_UNIX};
+
+    if (strncmp("unix:", path, strlen("unix:")) == 0)
+      path += strlen("unix:");
+    sstrncpy(sa.sun_path, path, sizeof(sa.sun_path));
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+      ERROR("rrdcached plugin: Connecting to %s failed: %s", daemon_address,
+            STRERRNO);
+      if (fd >= 0)
+        close(fd);
+      return -1;
+    }
+  } else {
+    char host[NI_MAXHOST];
+    char const *port = RC_DEFAULT_PORT;
+    struct addrinfo *ai_list;
+    char *p;
+
+    sstrncpy(host, daemon_address, sizeof(host));
+    if (host[0] == '[') {
+      /* "[address]:port" */
+      p = strchr(host, ']');
+      if (p == NULL) {
+        ERROR("rrdcached plugin: Invalid address: %s", daemon_address);
+        return -1;
+      }
+      *p = 0;
+      if (p[1] == ':')
+        port = p + 2;
+      memmove(host, host + 1, strlen(host + 1) + 1);
+    } else if ((p = strrchr(host, ':')) != NULL && strchr(host, ':') == p) {
+      *p = 0;
+      port = p + 1;
+    }
+
+    struct addrinfo ai_hints = {.ai_family = AF_UNSPEC,
+                                .ai_socktype = SOCK_STREAM};
+    int status = getaddrinfo(host, port, &ai_hints, &ai_list);
+    if (status != 0) {
+      ERROR("rrdcached plugin: getaddrinfo (%s, %s) failed: %s", host, port,
+            gai_strerror(status));
+      return -1;
+    }
+
+    for (struct addrinfo *ai = ai_list; ai != NULL; ai = ai->ai_next) {
+      fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (fd < 0)
+        continue;
+      if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+        break;
+      close(fd);
+      fd = -1;
+    }
+    freeaddrinfo(ai_list);
+
+    if (fd < 0) {
+      ERROR("rrdcached plugin: Connecting to %s failed: %s", daemon_address,
+            STRERRNO);
+      return -1;
+    }
+  }
+
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  batch_fd = fd;
+  return 0;
+} /* }}} int rc_batch_connect */
+
+/* Reads one line of the daemon's response and stores its leading status
+ * code in "code". Returns -1 on I/O errors. */
+static int rc_batch_read_line(char *buffer, size_t buffer_size, /* {{{ */
+                              int *code) {
+  size_t len = 0;
+
+  while (len + 1 < buffer_size) {
+    char c;
+    ssize_t status = read(batch_fd, &c, 1);
+    if (status < 0 && errno == EINTR)
+      continue;
+    if (status <= 0)
+      return -1;
+    if (c == '\n')
+      break;
+    buffer[len++] = c;
+  }
+  buffer[len] = 0;
+
+  *code = atoi(buffer);
+  return 0;
+} /* }}} int rc_batch_read_line */
+
+/* Sends one BATCH exchange and reads the result. Returns -1 on I/O errors and
+ * zero otherwise; errors reported for individual updates are logged. */
+static int rc_batch_exchange(char const *payload, size_t len) /* {{{ */
+{
+  char line[1024];
+  int code;
+
+  if (rc_batch_connect() != 0)
+    return -1;
+
+  if (swrite(batch_fd, payload, len) != 0) {
+    ERROR("rrdcached plugin: Sending updates failed: %s", STRERRNO);
+    return -1;
+  }
+
+  /* Reply to "BATCH": "0 Go ahead. ..." */
+  if (rc_batch_read_line(line, sizeof(line), &code) != 0) {
+    ERROR("rrdcached plugin: Reading from the daemon failed.");
+    return -1;
+  } else if (code != 0) {
+    ERROR("rrdcached plugin: BATCH command failed: %s", line);
+    return -1;
+  }
+
+  /* Reply to ".": "<n> errors", followed by one line per error. */
+  if (rc_batch_read_line(line, sizeof(line), &code) != 0) {
+    ERROR("rrdcached plugin: Reading from the daemon failed.");
+    return -1;
+  }
+
+  for (int i = 0; i < code; i++) {
+    char error[1024];
+    int unused;
+
+    if (rc_batch_read_line(error, sizeof(error), &unused) != 0) {
+      ERROR("rrdcached plugin: Reading from the daemon failed.");
+      return -1;
+    }
+    /* Only report the first few errors to avoid flooding the log. */
+    if (i < 5)
+      WARNING("rrdcached plugin: Update failed: %s", error);
+  }
+  if (code > 5)
+    WARNING("rrdcached plugin: %d more updates failed.", code - 5);
+
+  return 0;
+} /* }}} int rc_batch_exchange */
+
+/* Escapes the file name the same way librrd does and, for local daemons,
+ * makes it absolute as rrdc_update() would. */
+static int rc_batch_add_filename(char **buffer, size_t *len, /* {{{ */
+                                 size_t *size, char const *filename) {
+  char path[PATH_MAX];
+
+  if (filename[0] != '/' && rc_address_is_unix(daemon_address) &&
+      realpath(filename, path) != NULL)
+    filename = path;
+
+  for (char const *c = filename; *c != 0; c++) {
+    if (*c == ' ' || *c == '\\') {
+      if (rc_buffer_add(buffer, len, size, "\\", 1) != 0)
+        return ENOMEM;
+    }
+    if (rc_buffer_add(buffer, len, size, c, 1) != 0)
+      return ENOMEM;
+  }
+  return 0;
+} /* }}} int rc_batch_add_filename */
+
+/* Sends all updates in "tree" and destroys it. */
+static int rc_batch_send(c_avl_tree_t *tree, size_t values_num) /* {{{ */
+{
+  char *payload = NULL;
+  size_t len = 0;
+  size_t size = 0;
+  void *key;
+  void *value;
+  int status = 0;
+
+  status = rc_buffer_add(&payload, &len, &size, "BATCH\n", strlen("BATCH\n"));
+
+  while (c_avl_pick(tree, &key, &value) == 0) {
+    rc_batch_entry_t *e = value;
+
+    if (status == 0)
+      status = rc_buffer_add(&payload, &len, &size, "UPDATE ",
+                             strlen("UPDATE "));
+    if (status == 0)
+      status = rc_batch_add_filename(&payload, &len, &size, key);
+    if (status == 0)
+      status = rc_buffer_add(&payload, &len, &size, e->values, e->len);
+    if (status == 0)
+      status = rc_buffer_add(&payload, &len, &size, "\n", 1);
+
+    sfree(e->values);
+    sfree(e);
+    sfree(key);
+  }
+  c_avl_destroy(tree);
+
+  if (status == 0)
+    status = rc_buffer_add(&payload, &len, &size, ".\n", 2);
+  if (status != 0) {
+    ERROR("rrdcached plugin: Not enough memory to send %" PRIsz " updates.",
+          values_num);
+    sfree(payload);
+    return status;
+  }
+
+  pthread_mutex_lock(&batch_conn_lock);
+  status = rc_batch_exchange(payload, len);
+  if (status != 0) {
+    /* The connection may have been closed by the daemon; retry once. */
+    rc_batch_disconnect();
+    status = rc_batch_exchange(payload, len);
+    if (status != 0) {
+      rc_batch_disconnect();
+      ERROR("rrdcached plugin: Sending %" PRIsz " updates to %s failed.",
+            values_num, daemon_address);
+    }
+  }
+  pthread_mutex_unlock(&batch_conn_lock);
+
+  sfree(payload);
+  return status;
+} /* }}} int rc_batch_send */
+
+/* Takes the current batch if it is older than "timeout" (zero: always) and
+ * sends it. The batch lock is not held while sending, so other threads can
+ * keep adding updates. */
+static int rc_batch_flush(cdtime_t timeout) /* {{{ */
+{
+  c_avl_tree_t *tree;
+  size_t values_num;
+
+  pthread_mutex_lock(&batch_lock);
+  if (batch == NULL || batch_values == 0 ||
+      (timeout != 0 && (cdtime() - batch_start) < timeout)) {
+    pthread_mutex_unlock(&batch_lock);
+    return 0;
+  }
+  tree = batch;
+  values_num = batch_values;
+  batch = NULL;
+  batch_values = 0;
+  pthread_mutex_unlock(&batch_lock);
+
+  return rc_batch_send(tree, values_num);
+} /* }}} int rc_batch_flush */
+
+static int rc_batch_add(char const *filename, char const *values) /* {{{ */
+{
+  rc_batch_entry_t *e = NULL;
+  bool flush;
+
+  pthread_mutex_lock(&batch_lock);
+
+  if (batch == NULL) {
+    batch = c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (batch == NULL) {
+      pthread_mutex_unlock(&batch_lock);
+      return ENOMEM;
+    }
+  }
+
+  if (c_avl_get(batch, filename, (void *)&e) != 0) {
+    char *key = strdup(filename);
+    e = calloc(1, sizeof(*e));
+    if (key == NULL || e == NULL || c_avl_insert(batch, key, e) != 0) {
+      pthread_mutex_unlock(&batch_lock);
+      sfree(key);
+      sfree(e);
+      return ENOMEM;
+    }
+  }
+
+  if (rc_buffer_add(&e->values, &e->len, &e->size, " ", 1) != 0 ||
+      rc_buffer_add(&e->values, &e->len, &e->size, values, strlen(values)) !=
+          0) {
+    pthread_mutex_unlock(&batch_lock);
+    return ENOMEM;
+  }
+
+  if (batch_values == 0)
+    batch_start = cdtime();
+  batch_values++;
+
+  flush = (batch_values >= (size_t)batch_size) ||
+          ((cdtime() - batch_start) >= batch_timeout);
+  pthread_mutex_unlock(&batch_lock);
+
+  if (flush)
+    return rc_batch_flush(0);
+  return 0;
+} /* }}} int rc_batch_add */
+
 static int rc_read(void) {
 
   value_list_t vl = VALUE_LIST_INIT;
@@ -416,6 +795,9 @@ static int rc_write(const data_set_t *ds, const value_list_t *vl,
     }
   }
 
+  if (batch_size > 0)
+    return rc_batch_add(filename, values);
+
   rrd_clear_error();
   status = rrdc_connect(daemon_address);
   if (status != 0) {
@@ -453,9 +835,16 @@ static int rc_write(const data_set_t *ds, const value_list_t *vl,
   return 0;
 } /* int rc_write */
 
-static int rc_flush(__attribute__((unused)) cdtime_t timeout, /* {{{ */
+static int rc_flush(cdtime_t timeout, /* {{{ */
                     const char *identifier,
                     __attribute__((unused)) user_data_t *ud) {
+  if (batch_size > 0) {
+    /* Updates for the file may be waiting in the batch. */
+    int status = rc_batch_flush((identifier == NULL) ? timeout : 0);
+    if (status != 0 || identifier == NULL)
+      return status;
+  }
+
   if (identifier == NULL)
     return EINVAL;
 
@@ -502,6 +891,15 @@ static int rc_flush(__attribute__((unused)) cdtime_t timeout, /* {{{ */
 } /* }}} int rc_flush */
 
 static int rc_shutdown(void) {
+  cu_rrd_create_shutdown();
+
+  if (batch_size > 0) {
+    rc_batch_flush(0);
+    pthread_mutex_lock(&batch_conn_lock);
+    rc_batch_disconnect();
+    pthread_mutex_unlock(&batch_conn_lock);
+  }
+
   rrdc_disconnect();
   return 0;
 } /* int rc_shutdown */
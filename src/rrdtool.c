@@ -43,6 +43,14 @@ typedef struct rrd_cache_s {
   cdtime_t last_value;
   int64_t random_variation;
   enum { FLAG_NONE = 0x00, FLAG_QUEUED = 0x01, FLAG_FLUSHQ = 0x02 } flags;
+
+  /* Timer wheel linkage, see rrd_wheel_insert(). "key" points to the key
+   * this entry is stored under in the cache tree. */
+  char *key;
+  cdtime_t deadline;
+  bool scheduled;
+  struct rrd_cache_s *wheel_prev;
+  struct rrd_cache_s *wheel_next;
 } rrd_cache_t;
 
 enum rrd_queue_dir_e { QUEUE_INSERT_FRONT, QUEUE_INSERT_BACK };
@@ -54,13 +62,29 @@ struct rrd_queue_s {
 };
 typedef struct rrd_queue_s rrd_queue_t;
 
+/* Update threads own disjoint sets of files, selected by the hash of the file
+ * name, so that every file is only ever updated by one thread and values are
+ * written in order. */
+struct rrd_shard_s {
+  rrd_queue_t *queue_head;
+  rrd_queue_t *queue_tail;
+  rrd_queue_t *flushq_head;
+  rrd_queue_t *flushq_tail;
+  pthread_t thread;
+  bool thread_running;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+typedef struct rrd_shard_s rrd_shard_t;
+
 /*
  * Private variables
  */
 static const char *config_keys[] = {
     "CacheTimeout", "CacheFlush",      "CreateFilesAsync", "DataDir",
     "StepSize",     "HeartBeat",       "RRARows",          "RRATimespan",
-    "XFF",          "WritesPerSecond", "RandomTimeout"};
+    "XFF",          "WritesPerSecond", "RandomTimeout",    "UpdateThreads",
+    "CreateThreads", "CreateQueueLength", "CreateFromTemplate"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 /* If datadir is zero, the daemon's basedir is used. If stepsize or heartbeat
@@ -80,25 +104,30 @@ static rrdcreate_config_t rrdcreate_config = {
     /* consolidation_functions = */ NULL,
     /* consolidation_functions_num = */ 0,
 
-    /* async = */ 0};
+    /* async = */ 0,
+    /* async_threads = */ 0,
+    /* async_queue_length = */ 0,
+    /* templates = */ 0};
 
-/* XXX: If you need to lock both, cache_lock and queue_lock, at the same time,
- * ALWAYS lock `cache_lock' first! */
+/* XXX: If you need to lock both, cache_lock and a shard's lock, at the same
+ * time, ALWAYS lock `cache_lock' first! */
 static cdtime_t cache_timeout;
 static cdtime_t cache_flush_timeout;
 static cdtime_t random_timeout;
-static cdtime_t cache_flush_last;
 static c_avl_tree_t *cache;
 static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
 
-static rrd_queue_t *queue_head;
-static rrd_queue_t *queue_tail;
-static rrd_queue_t *flushq_head;
-static rrd_queue_t *flushq_tail;
-static pthread_t queue_thread;
-static int queue_thread_running = 1;
-static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+/* Hashed timer wheel of cache entries, keyed by the time they are due to be
+ * written. Entries are in slot (deadline / RRD_WHEEL_TICK) % RRD_WHEEL_SLOTS;
+ * entries further in the future than one rotation just stay in their slot
+ * until it comes around again. Protected by cache_lock. */
+#define RRD_WHEEL_SLOTS 1024
+#define RRD_WHEEL_TICK TIME_T_TO_CDTIME_T(1)
+static rrd_cache_t *wheel[RRD_WHEEL_SLOTS];
+static uint64_t wheel_tick;
+
+static rrd_shard_t *shards;
+static size_t shards_num = 1;
 
 #if !HAVE_THREADSAFE_LIBRRD
 static pthread_mutex_t librrd_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -279,9 +308,59 @@ static int value_list_to_filename(char *buffer, size_t buffer_size,
   return 0;
 } /* int value_list_to_filename */
 
-static void *rrd_queue_thread(void __attribute__((unused)) * data) {
+static int64_t rrd_get_random_variation(void) {
+  if (random_timeout == 0)
+    return 0;
+
+  return (int64_t)cdrand_range(-random_timeout, random_timeout);
+} /* int64_t rrd_get_random_variation */
+
+/* XXX: You must hold "cache_lock" when calling this function! */
+static void rrd_wheel_remove(rrd_cache_t *rc) {
+  if (!rc->scheduled)
+    return;
+
+  if (rc->wheel_prev != NULL)
+    rc->wheel_prev->wheel_next = rc->wheel_next;
+  else
+    wheel[(rc->deadline / RRD_WHEEL_TICK) % RRD_WHEEL_SLOTS] = rc->wheel_next;
+  if (rc->wheel_next != NULL)
+    rc->wheel_next->wheel_prev = rc->wheel_prev;
+
+  rc->wheel_prev = NULL;
+  rc->wheel_next = NULL;
+  rc->scheduled = false;
+} /* void rrd_wheel_remove */
+
+/* XXX: You must hold "cache_lock" when calling this function! */
+static void rrd_wheel_insert(rrd_cache_t *rc, cdtime_t deadline) {
+  rrd_wheel_remove(rc);
+
+  /* Deadlines in the past are handled on the next tick. */
+  if ((deadline / RRD_WHEEL_TICK) <= wheel_tick)
+    deadline = (wheel_tick + 1) * RRD_WHEEL_TICK;
+
+  rrd_cache_t **slot = wheel + ((deadline / RRD_WHEEL_TICK) % RRD_WHEEL_SLOTS);
+
+  rc->deadline = deadline;
+  rc->wheel_prev = NULL;
+  rc->wheel_next = *slot;
+  if (*slot != NULL)
+    (*slot)->wheel_prev = rc;
+  *slot = rc;
+  rc->scheduled = true;
+} /* void rrd_wheel_insert */
+
+static rrd_shard_t *rrd_shard_get(const char *filename) {
+  return shards + (hash_name(filename) % shards_num);
+} /* rrd_shard_t *rrd_shard_get */
+
+static void *rrd_queue_thread(void *data) {
+  rrd_shard_t *shard = data;
   struct timeval tv_next_update;
   struct timeval tv_now;
+  /* "WritesPerSecond" is the limit for all threads together. */
+  double thread_write_rate = write_rate * (double)shards_num;
 
   gettimeofday(&tv_next_update, /* timezone = */ NULL);
 
@@ -295,20 +374,20 @@ static void *rrd_queue_thread(void __attribute__((unused)) * data) {
     values = NULL;
     values_num = 0;
 
-    pthread_mutex_lock(&queue_lock);
+    pthread_mutex_lock(&shard->lock);
     /* Wait for values to arrive */
     while (42) {
       struct timespec ts_wait;
 
-      while ((flushq_head == NULL) && (queue_head == NULL) &&
+      while ((shard->flushq_head == NULL) && (shard->queue_head == NULL) &&
              (do_shutdown == 0))
-        pthread_cond_wait(&queue_cond, &queue_lock);
+        pthread_cond_wait(&shard->cond, &shard->lock);
 
-      if ((flushq_head == NULL) && (queue_head == NULL))
+      if ((shard->flushq_head == NULL) && (shard->queue_head == NULL))
         break;
 
       /* Don't delay if there's something to flush */
-      if (flushq_head != NULL)
+      if (shard->flushq_head != NULL)
         break;
 
       /* Don't delay if we're shutting down */
@@ -316,7 +395,7 @@ static void *rrd_queue_thread(void __attribute__((unused)) * data) {
         break;
 
       /* Don't delay if no delay was configured. */
-      if (write_rate <= 0.0)
+      if (thread_write_rate <= 0.0)
         break;
 
       gettimeofday(&tv_now, /* timezone = */ NULL);
@@ -331,39 +410,40 @@ static void *rrd_queue_thread(void __attribute__((unused)) * data) {
       ts_wait.tv_sec = tv_next_update.tv_sec;
       ts_wait.tv_nsec = 1000 * tv_next_update.tv_usec;
 
-      status = pthread_cond_timedwait(&queue_cond, &queue_lock, &ts_wait);
+      status =
+          pthread_cond_timedwait(&shard->cond, &shard->lock, &ts_wait);
       if (status == ETIMEDOUT)
         break;
     } /* while (42) */
 
-    /* XXX: If you need to lock both, cache_lock and queue_lock, at
+    /* XXX: If you need to lock both, cache_lock and a shard's lock, at
      * the same time, ALWAYS lock `cache_lock' first! */
 
     /* We're in the shutdown phase */
-    if ((flushq_head == NULL) && (queue_head == NULL)) {
-      pthread_mutex_unlock(&queue_lock);
+    if ((shard->flushq_head == NULL) && (shard->queue_head == NULL)) {
+      pthread_mutex_unlock(&shard->lock);
       break;
     }
 
-    if (flushq_head != NULL) {
+    if (shard->flushq_head != NULL) {
       /* Dequeue the first flush entry */
-      queue_entry = flushq_head;
-      if (flushq_head == flushq_tail)
-        flushq_head = flushq_tail = NULL;
+      queue_entry = shard->flushq_head;
+      if (shard->flushq_head == shard->flushq_tail)
+        shard->flushq_head = shard->flushq_tail = NULL;
       else
-        flushq_head = flushq_head->next;
-    } else /* if (queue_head != NULL) */
+        shard->flushq_head = shard->flushq_head->next;
+    } else /* if (shard->queue_head != NULL) */
     {
       /* Dequeue the first regular entry */
-      queue_entry = queue_head;
-      if (queue_head == queue_tail)
-        queue_head = queue_tail = NULL;
+      queue_entry = shard->queue_head;
+      if (shard->queue_head == shard->queue_tail)
+        shard->queue_head = shard->queue_tail = NULL;
       else
-        queue_head = queue_head->next;
+        shard->queue_head = shard->queue_head->next;
     }
 
     /* Unlock the queue again */
-    pthread_mutex_unlock(&queue_lock);
+    pthread_mutex_unlock(&shard->lock);
 
     /* We now need the cache lock so the entry isn't updated while
      * we make a copy of its values */
@@ -378,6 +458,10 @@ static void *rrd_queue_thread(void __attribute__((unused)) * data) {
       cache_entry->values = NULL;
       cache_entry->values_num = 0;
       cache_entry->flags = FLAG_NONE;
+
+      /* Remove the entry from the cache if no new values arrive. */
+      if (cache_timeout > 0)
+        rrd_wheel_insert(cache_entry, cdtime() + cache_flush_timeout);
     }
 
     pthread_mutex_unlock(&cache_lock);
@@ -389,11 +473,11 @@ static void *rrd_queue_thread(void __attribute__((unused)) * data) {
     }
 
     /* Update `tv_next_update' */
-    if (write_rate > 0.0) {
+    if (thread_write_rate > 0.0) {
       gettimeofday(&tv_now, /* timezone = */ NULL);
       tv_next_update.tv_sec = tv_now.tv_sec;
       tv_next_update.tv_usec =
-          tv_now.tv_usec + ((suseconds_t)(1000000 * write_rate));
+          tv_now.tv_usec + ((suseconds_t)(1000000 * thread_write_rate));
       while (tv_next_update.tv_usec > 1000000) {
         tv_next_update.tv_sec++;
         tv_next_update.tv_usec -= 1000000;
@@ -417,8 +501,10 @@ static void *rrd_queue_thread(void __attribute__((unused)) * data) {
   return (void *)0;
 } /* void *rrd_queue_thread */
 
-static int rrd_queue_enqueue(const char *filename, rrd_queue_t **head,
-                             rrd_queue_t **tail) {
+static int rrd_queue_enqueue(const char *filename, bool flush) {
+  rrd_shard_t *shard = rrd_shard_get(filename);
+  rrd_queue_t **head = flush ? &shard->flushq_head : &shard->queue_head;
+  rrd_queue_t **tail = flush ? &shard->flushq_tail : &shard->queue_tail;
   rrd_queue_t *queue_entry;
 
   queue_entry = malloc(sizeof(*queue_entry));
@@ -433,7 +519,7 @@ static int rrd_queue_enqueue(const char *filename, rrd_queue_t **head,
 
   queue_entry->next = NULL;
 
-  pthread_mutex_lock(&queue_lock);
+  pthread_mutex_lock(&shard->lock);
 
   if (*tail == NULL)
     *head = queue_entry;
@@ -441,18 +527,20 @@ static int rrd_queue_enqueue(const char *filename, rrd_queue_t **head,
     (*tail)->next = queue_entry;
   *tail = queue_entry;
 
-  pthread_cond_signal(&queue_cond);
-  pthread_mutex_unlock(&queue_lock);
+  pthread_cond_signal(&shard->cond);
+  pthread_mutex_unlock(&shard->lock);
 
   return 0;
 } /* int rrd_queue_enqueue */
 
-static int rrd_queue_dequeue(const char *filename, rrd_queue_t **head,
-                             rrd_queue_t **tail) {
+static int rrd_queue_dequeue(const char *filename) {
+  rrd_shard_t *shard = rrd_shard_get(filename);
+  rrd_queue_t **head = &shard->queue_head;
+  rrd_queue_t **tail = &shard->queue_tail;
   rrd_queue_t *this;
   rrd_queue_t *prev;
 
-  pthread_mutex_lock(&queue_lock);
+  pthread_mutex_lock(&shard->lock);
 
   prev = NULL;
   this = *head;
@@ -466,7 +554,7 @@ static int rrd_queue_dequeue(const char *filename, rrd_queue_t **head,
   }
 
   if (this == NULL) {
-    pthread_mutex_unlock(&queue_lock);
+    pthread_mutex_unlock(&shard->lock);
     return -1;
   }
 
@@ -478,7 +566,7 @@ static int rrd_queue_dequeue(const char *filename, rrd_queue_t **head,
   if (this->next == NULL)
     *tail = prev;
 
-  pthread_mutex_unlock(&queue_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   sfree(this->filename);
   sfree(this);
@@ -486,6 +574,58 @@ static int rrd_queue_dequeue(const char *filename, rrd_queue_t **head,
   return 0;
 } /* int rrd_queue_dequeue */
 
+/* Handles all entries that are due at "now": entries with values are queued
+ * for writing, entries which haven't received any values since they were
+ * last written are removed from the cache. Only the slots between the last
+ * call and "now" are looked at.
+ * XXX: You must hold "cache_lock" when calling this function! */
+static void rrd_wheel_advance(cdtime_t now) {
+  uint64_t now_tick = now / RRD_WHEEL_TICK;
+  uint64_t ticks;
+
+  if (now_tick <= wheel_tick)
+    return;
+
+  ticks = now_tick - wheel_tick;
+  if (ticks > RRD_WHEEL_SLOTS)
+    ticks = RRD_WHEEL_SLOTS;
+
+  for (uint64_t i = 1; i <= ticks; i++) {
+    rrd_cache_t *rc = wheel[(wheel_tick + i) % RRD_WHEEL_SLOTS];
+
+    while (rc != NULL) {
+      rrd_cache_t *next = rc->wheel_next;
+
+      if (rc->deadline > now) {
+        rc = next;
+        continue;
+      }
+
+      rrd_wheel_remove(rc);
+
+      if (rc->flags != FLAG_NONE) {
+        /* Already queued. */
+      } else if (rc->values_num > 0) {
+        if (rrd_queue_enqueue(rc->key, /* flush = */ false) == 0)
+          rc->flags = FLAG_QUEUED;
+        rc->random_variation = rrd_get_random_variation();
+      } else {
+        /* No new values since the last write -> waste of memory */
+        void *key = NULL;
+
+        if (c_avl_remove(cache, rc->key, &key, NULL) == 0) {
+          sfree(key);
+          sfree(rc);
+        }
+      }
+
+      rc = next;
+    }
+  }
+
+  wheel_tick = now_tick;
+} /* void rrd_wheel_advance */
+
 /* XXX: You must hold "cache_lock" when calling this function! */
 static void rrd_cache_flush(cdtime_t timeout) {
   rrd_cache_t *rc;
@@ -513,9 +653,11 @@ static void rrd_cache_flush(cdtime_t timeout) {
     else if (rc->values_num > 0) {
       int status;
 
-      status = rrd_queue_enqueue(key, &queue_head, &queue_tail);
-      if (status == 0)
+      status = rrd_queue_enqueue(key, /* flush = */ false);
+      if (status == 0) {
         rc->flags = FLAG_QUEUED;
+        rrd_wheel_remove(rc);
+      }
     } else /* ancient and no values -> waste of memory */
     {
       char **tmp = realloc(keys, (keys_num + 1) * sizeof(char *));
@@ -541,14 +683,13 @@ static void rrd_cache_flush(cdtime_t timeout) {
     assert(rc->values == NULL);
     assert(rc->values_num == 0);
 
+    rrd_wheel_remove(rc);
     sfree(rc);
     sfree(key);
     keys[i] = NULL;
   } /* for (i = 0..keys_num) */
 
   sfree(keys);
-
-  cache_flush_last = now;
 } /* void rrd_cache_flush */
 
 static int rrd_cache_flush_identifier(cdtime_t timeout,
@@ -582,28 +723,23 @@ static int rrd_cache_flush_identifier(cdtime_t timeout,
   if (rc->flags == FLAG_FLUSHQ) {
     status = 0;
   } else if (rc->flags == FLAG_QUEUED) {
-    rrd_queue_dequeue(key, &queue_head, &queue_tail);
-    status = rrd_queue_enqueue(key, &flushq_head, &flushq_tail);
+    rrd_queue_dequeue(key);
+    status = rrd_queue_enqueue(key, /* flush = */ true);
     if (status == 0)
       rc->flags = FLAG_FLUSHQ;
   } else if ((now - rc->first_value) < timeout) {
     status = 0;
   } else if (rc->values_num > 0) {
-    status = rrd_queue_enqueue(key, &flushq_head, &flushq_tail);
-    if (status == 0)
+    status = rrd_queue_enqueue(key, /* flush = */ true);
+    if (status == 0) {
       rc->flags = FLAG_FLUSHQ;
+      rrd_wheel_remove(rc);
+    }
   }
 
   return status;
 } /* int rrd_cache_flush_identifier */
 
-static int64_t rrd_get_random_variation(void) {
-  if (random_timeout == 0)
-    return 0;
-
-  return (int64_t)cdrand_range(-random_timeout, random_timeout);
-} /* int64_t rrd_get_random_variation */
-
 static int rrd_cache_insert(const char *filename, const char *value,
                             cdtime_t value_time) {
   rrd_cache_t *rc = NULL;
@@ -634,6 +770,11 @@ static int rrd_cache_insert(const char *filename, const char *value,
     rc->last_value = 0;
     rc->random_variation = rrd_get_random_variation();
     rc->flags = FLAG_NONE;
+    rc->key = NULL;
+    rc->deadline = 0;
+    rc->scheduled = false;
+    rc->wheel_prev = NULL;
+    rc->wheel_next = NULL;
     new_rc = 1;
   }
 
@@ -652,6 +793,7 @@ static int rrd_cache_insert(const char *filename, const char *value,
     void *cache_key = NULL;
 
     c_avl_remove(cache, filename, &cache_key, NULL);
+    rrd_wheel_remove(rc);
     pthread_mutex_unlock(&cache_lock);
 
     ERROR("rrdtool plugin: realloc failed: %s", STRERRNO);
@@ -687,6 +829,7 @@ static int rrd_cache_insert(const char *filename, const char *value,
     }
 
     c_avl_insert(cache, cache_key, rc);
+    rc->key = cache_key;
   }
 
   DEBUG("rrdtool plugin: rrd_cache_insert: file = %s; "
@@ -696,24 +839,30 @@ static int rrd_cache_insert(const char *filename, const char *value,
 
   if ((rc->last_value - rc->first_value) >=
       (cache_timeout + rc->random_variation)) {
-    /* XXX: If you need to lock both, cache_lock and queue_lock, at
+    /* XXX: If you need to lock both, cache_lock and a shard's lock, at
      * the same time, ALWAYS lock `cache_lock' first! */
     if (rc->flags == FLAG_NONE) {
       int status;
 
-      status = rrd_queue_enqueue(filename, &queue_head, &queue_tail);
-      if (status == 0)
+      status = rrd_queue_enqueue(filename, /* flush = */ false);
+      if (status == 0) {
         rc->flags = FLAG_QUEUED;
+        rrd_wheel_remove(rc);
+      }
 
       rc->random_variation = rrd_get_random_variation();
     } else {
       DEBUG("rrdtool plugin: `%s' is already queued.", filename);
     }
+  } else if ((cache_timeout > 0) && (rc->values_num == 1) &&
+             (rc->flags == FLAG_NONE)) {
+    /* Make sure the value is written even if no further values arrive. */
+    rrd_wheel_insert(rc, rc->first_value + cache_timeout +
+                             rc->random_variation);
   }
 
-  if ((cache_timeout > 0) &&
-      ((cdtime() - cache_flush_last) > cache_flush_timeout))
-    rrd_cache_flush(cache_timeout + random_timeout);
+  if (cache_timeout > 0)
+    rrd_wheel_advance(cdtime());
 
   pthread_mutex_unlock(&cache_lock);
 
@@ -754,6 +903,7 @@ static int rrd_cache_destroy(void) /* {{{ */
 
   c_avl_destroy(cache);
   cache = NULL;
+  memset(wheel, 0, sizeof(wheel));
 
   if (non_empty > 0) {
     INFO("rrdtool plugin: %i cache %s had values when destroying the cache.",
@@ -899,6 +1049,22 @@ static int rrd_config(const char *key, const char *value) {
       rrdcreate_config.async = 1;
     else
       rrdcreate_config.async = 0;
+  } else if (strcasecmp("CreateThreads", key) == 0) {
+    int tmp = atoi(value);
+    if (tmp < 1) {
+      ERROR("rrdtool plugin: `CreateThreads' must be at least 1.");
+      return 1;
+    }
+    rrdcreate_config.async_threads = tmp;
+  } else if (strcasecmp("CreateQueueLength", key) == 0) {
+    int tmp = atoi(value);
+    if (tmp < 0) {
+      ERROR("rrdtool plugin: `CreateQueueLength' must not be negative.");
+      return 1;
+    }
+    rrdcreate_config.async_queue_length = tmp;
+  } else if (strcasecmp("CreateFromTemplate", key) == 0) {
+    rrdcreate_config.templates = IS_TRUE(value);
   } else if (strcasecmp("RRARows", key) == 0) {
     int tmp = atoi(value);
     if (tmp <= 0) {
@@ -966,6 +1132,18 @@ static int rrd_config(const char *key, const char *value) {
     } else {
       write_rate = 1.0 / wps;
     }
+  } else if (strcasecmp("UpdateThreads", key) == 0) {
+    int tmp = atoi(value);
+    if (tmp < 1) {
+      ERROR("rrdtool plugin: `UpdateThreads' must be at least 1.");
+      return 1;
+    }
+#if !HAVE_THREADSAFE_LIBRRD
+    if (tmp > 1)
+      WARNING("rrdtool plugin: librrd is not thread-safe, so updates are "
+              "serialized. Using more than one update thread won't help.");
+#endif
+    shards_num = (size_t)tmp;
   } else if (strcasecmp("RandomTimeout", key) == 0) {
     double tmp;
 
@@ -985,32 +1163,57 @@ static int rrd_config(const char *key, const char *value) {
 } /* int rrd_config */
 
 static int rrd_shutdown(void) {
+  bool pending = false;
+  bool running = false;
+
+  cu_rrd_create_shutdown();
+
+  /* Without shards there's nobody to write the cached values. */
+  if (shards == NULL) {
+    rrd_cache_destroy();
+    return 0;
+  }
+
   pthread_mutex_lock(&cache_lock);
   rrd_cache_flush(0);
   pthread_mutex_unlock(&cache_lock);
 
-  pthread_mutex_lock(&queue_lock);
   do_shutdown = 1;
-  pthread_cond_signal(&queue_cond);
-  pthread_mutex_unlock(&queue_lock);
+  for (size_t i = 0; i < shards_num; i++) {
+    rrd_shard_t *shard = shards + i;
 
-  if ((queue_thread_running != 0) &&
-      ((queue_head != NULL) || (flushq_head != NULL))) {
+    pthread_mutex_lock(&shard->lock);
+    pthread_cond_signal(&shard->cond);
+    if ((shard->queue_head != NULL) || (shard->flushq_head != NULL))
+      pending = true;
+    pthread_mutex_unlock(&shard->lock);
+
+    if (shard->thread_running)
+      running = true;
+  }
+
+  if (running && pending) {
     INFO("rrdtool plugin: Shutting down the queue thread. "
          "This may take a while.");
-  } else if (queue_thread_running != 0) {
+  } else if (running) {
     INFO("rrdtool plugin: Shutting down the queue thread.");
   }
 
   /* Wait for all the values to be written to disk before returning. */
-  if (queue_thread_running != 0) {
-    pthread_join(queue_thread, NULL);
-    memset(&queue_thread, 0, sizeof(queue_thread));
-    queue_thread_running = 0;
-    DEBUG("rrdtool plugin: queue_thread exited.");
+  for (size_t i = 0; i < shards_num; i++) {
+    rrd_shard_t *shard = shards + i;
+
+    if (shard->thread_running) {
+      pthread_join(shard->thread, NULL);
+      shard->thread_running = false;
+      DEBUG("rrdtool plugin: queue thread %" PRIsz " exited.", i);
+    }
+    pthread_cond_destroy(&shard->cond);
+    pthread_mutex_destroy(&shard->lock);
   }
 
   rrd_cache_destroy();
+  sfree(shards);
 
   return 0;
 } /* int rrd_shutdown */
@@ -1035,7 +1238,7 @@ static int rrd_init(void) {
     return -1;
   }
 
-  cache_flush_last = cdtime();
+  wheel_tick = cdtime() / RRD_WHEEL_TICK;
   if (cache_timeout == 0) {
     random_timeout = 0;
     cache_flush_timeout = 0;
@@ -1057,13 +1260,26 @@ static int rrd_init(void) {
 
   pthread_mutex_unlock(&cache_lock);
 
-  int status = plugin_thread_create(&queue_thread, rrd_queue_thread,
-                                    /* args = */ NULL, "rrdtool queue");
-  if (status != 0) {
-    ERROR("rrdtool plugin: Cannot create queue-thread.");
+  shards = calloc(shards_num, sizeof(*shards));
+  if (shards == NULL) {
+    ERROR("rrdtool plugin: calloc failed.");
     return -1;
   }
-  queue_thread_running = 1;
+
+  for (size_t i = 0; i < shards_num; i++) {
+    pthread_mutex_init(&shards[i].lock, /* attr = */ NULL);
+    pthread_cond_init(&shards[i].cond, /* attr = */ NULL);
+  }
+
+  for (size_t i = 0; i < shards_num; i++) {
+    int status = plugin_thread_create(&shards[i].thread, rrd_queue_thread,
+                                      shards + i, "rrdtool queue");
+    if (status != 0) {
+      ERROR("rrdtool plugin: Cannot create queue-thread.");
+      return -1;
+    }
+    shards[i].thread_running = true;
+  }
 
   DEBUG("rrdtool plugin: rrd_init: datadir = %s; stepsize = %lu;"
         " heartbeat = %i; rrarows = %i; xff = %lf;",
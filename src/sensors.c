@@ -39,6 +39,9 @@
 #include "utils/common/common.h"
 #include "utils/ignorelist/ignorelist.h"
 
+#include <dirent.h>
+#include <fcntl.h>
+
 #if defined(HAVE_SENSORS_SENSORS_H)
 #include <sensors/sensors.h>
 #endif
@@ -48,7 +51,8 @@
 #endif
 
 static const char *config_keys[] = {"Sensor", "IgnoreSelected",
-                                    "SensorConfigFile", "UseLabels"};
+                                    "SensorConfigFile", "UseLabels",
+                                    "Backend"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 #if SENSORS_API_VERSION < 0x400
@@ -70,15 +74,38 @@ typedef struct featurelist {
   const sensors_chip_name *chip;
   const sensors_feature *feature;
   const sensors_subfeature *subfeature;
+  /* The identifier is set up when the features are loaded, which is also
+   * when the ignorelist is applied. */
+  char plugin_instance[DATA_MAX_NAME_LEN];
+  char type_instance[DATA_MAX_NAME_LEN];
+  const char *type;
+  /* The subfeature's sysfs file, kept open with the "sysfs" backend, or -1
+   * if the value is read through libsensors. */
+  int fd;
+  /* Divisor of the raw sysfs value */
+  double scale;
   struct featurelist *next;
 } featurelist_t;
 
+#define SENSORS_HWMON_PATH "/sys/class/hwmon"
+#define SENSORS_DISPATCH_BATCH 64
+
 static char *conffile;
 static bool use_labels;
+static bool use_sysfs;
+/* Hash of the hwmon device names the features were loaded for. */
+static uint64_t hwmon_signature;
+
+static struct {
+  value_list_t vls[SENSORS_DISPATCH_BATCH];
+  value_t values[SENSORS_DISPATCH_BATCH];
+  size_t num;
+} sensors_batch;
 #endif
 
 static featurelist_t *first_feature;
 static ignorelist_t *sensor_list;
+static bool conf_loaded;
 
 static int sensors_config(const char *key, const char *value) {
   if (sensor_list == NULL)
@@ -107,6 +134,17 @@ static int sensors_config(const char *key, const char *value) {
 #if (SENSORS_API_VERSION >= 0x400)
   else if (strcasecmp(key, "UseLabels") == 0) {
     use_labels = IS_TRUE(value);
+  } else if (strcasecmp(key, "Backend") == 0) {
+    if (strcasecmp(value, "sysfs") == 0)
+      use_sysfs = true;
+    else if (strcasecmp(value, "libsensors") == 0)
+      use_sysfs = false;
+    else {
+      ERROR("sensors plugin: Unknown backend \"%s\". Valid backends are "
+            "\"libsensors\" and \"sysfs\".",
+            value);
+      return 1;
+    }
   }
 #endif
   else {
@@ -126,13 +164,135 @@ static void sensors_free_features(void) {
 
   for (featurelist_t *thisft = first_feature; thisft != NULL; thisft = nextft) {
     nextft = thisft->next;
+#if (SENSORS_API_VERSION >= 0x400)
+    if (thisft->fd >= 0)
+      close(thisft->fd);
+#endif
     sfree(thisft);
   }
   first_feature = NULL;
 }
 
+#if (SENSORS_API_VERSION >= 0x400)
+static const char *sensors_type_name(sensors_feature_type type) {
+  switch (type) {
+  case SENSORS_FEATURE_IN:
+    return "voltage";
+  case SENSORS_FEATURE_FAN:
+    return "fanspeed";
+  case SENSORS_FEATURE_TEMP:
+    return "temperature";
+  case SENSORS_FEATURE_POWER:
+    return "power";
+#if SENSORS_API_VERSION >= 0x402
+  case SENSORS_FEATURE_CURR:
+    return "current";
+#endif
+#if SENSORS_API_VERSION >= 0x431
+  case SENSORS_FEATURE_HUMIDITY:
+    return "humidity";
+#endif
+  default:
+    return NULL;
+  }
+} /* const char *sensors_type_name */
+
+/* The units of sysfs values, by which libsensors divides them before it
+ * applies "compute" statements; see get_type_scaling() in its sysfs.c. */
+static double sensors_sysfs_scale(sensors_subfeature_type type) {
+  switch (type) {
+  case SENSORS_SUBFEATURE_FAN_INPUT:
+    return 1.0;
+  case SENSORS_SUBFEATURE_POWER_INPUT:
+    return 1000000.0;
+  default:
+    return 1000.0;
+  }
+} /* double sensors_sysfs_scale */
+
+static int sensors_sysfs_read(featurelist_t const *fl, double *ret_value) {
+  char buffer[32];
+
+  ssize_t len = pread(fl->fd, buffer, sizeof(buffer) - 1, 0);
+  if (len < 0)
+    return -1;
+  buffer[len] = 0;
+
+  char *endptr = NULL;
+  errno = 0;
+  long long raw = strtoll(buffer, &endptr, 10);
+  if ((errno != 0) || (endptr == buffer)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  *ret_value = ((double)raw) / fl->scale;
+  return 0;
+} /* int sensors_sysfs_read */
+
+/* Opens the sysfs file of "fl", unless libsensors reports a value different
+ * from the scaled sysfs one. That is the case when sensors.conf has a
+ * "compute" statement for the feature, which only libsensors can apply. */
+static void sensors_sysfs_open(featurelist_t *fl) {
+  char path[PATH_MAX];
+  double sysfs_value;
+  double value;
+
+  if ((fl->chip->path == NULL) ||
+      (snprintf(path, sizeof(path), "%s/%s", fl->chip->path,
+                fl->subfeature->name) >= (int)sizeof(path)))
+    return;
+
+  fl->fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fl->fd < 0) {
+    DEBUG("sensors plugin: open(%s) failed: %s", path, STRERRNO);
+    return;
+  }
+  fl->scale = sensors_sysfs_scale(fl->subfeature->type);
+
+  if ((sensors_sysfs_read(fl, &sysfs_value) == 0) &&
+      (sensors_get_value(fl->chip, fl->subfeature->number, &value) >= 0) &&
+      (fabs(sysfs_value - value) <= 1e-6 * ((fabs(value) > 1.0) ? fabs(value)
+                                                                  : 1.0)))
+    return;
+
+  DEBUG("sensors plugin: Reading %s through libsensors, because the value "
+        "reported by libsensors differs from the sysfs one.",
+        path);
+  close(fl->fd);
+  fl->fd = -1;
+} /* void sensors_sysfs_open */
+
+/* Returns a hash of the hwmon device names, which changes when a device is
+ * added or removed. */
+static uint64_t sensors_hwmon_signature(void) {
+  uint64_t signature = 0;
+  struct dirent *de;
+
+  DIR *dh = opendir(SENSORS_HWMON_PATH);
+  if (dh == NULL)
+    return 0;
+
+  while ((de = readdir(dh)) != NULL) {
+    uint64_t h = 14695981039346656037ULL;
+
+    if (de->d_name[0] == '.')
+      continue;
+
+    for (const char *p = de->d_name; *p != 0; p++) {
+      h ^= (uint64_t)(unsigned char)*p;
+      h *= 1099511628211ULL;
+    }
+    /* Independent of the order of the directory entries */
+    signature += h;
+  }
+
+  closedir(dh);
+  return signature;
+} /* uint64_t sensors_hwmon_signature */
+#endif /* (SENSORS_API_VERSION >= 0x400) */
+
 static int sensors_load_conf(void) {
-  static int call_once;
 
   FILE *fh = NULL;
   featurelist_t *last_feature = NULL;
@@ -142,10 +302,10 @@ static int sensors_load_conf(void) {
 
   int status;
 
-  if (call_once)
+  if (conf_loaded)
     return 0;
 
-  call_once = 1;
+  conf_loaded = true;
 
   if (conffile != NULL) {
     fh = fopen(conffile, "r");
@@ -233,6 +393,9 @@ static int sensors_load_conf(void) {
       /* #endif SENSORS_API_VERSION < 0x400 */
 
 #elif (SENSORS_API_VERSION >= 0x400)
+  if (use_sysfs)
+    hwmon_signature = sensors_hwmon_signature();
+
   chip_num = 0;
   while ((chip = sensors_get_detected_chips(NULL, &chip_num)) != NULL) {
     const sensors_feature *feature;
@@ -243,16 +406,8 @@ static int sensors_load_conf(void) {
       int subfeature_num = 0;
 
       /* Only handle voltage, fanspeeds and temperatures */
-      if ((feature->type != SENSORS_FEATURE_IN) &&
-          (feature->type != SENSORS_FEATURE_FAN) &&
-          (feature->type != SENSORS_FEATURE_TEMP) &&
-#if SENSORS_API_VERSION >= 0x402
-          (feature->type != SENSORS_FEATURE_CURR) &&
-#endif
-#if SENSORS_API_VERSION >= 0x431
-          (feature->type != SENSORS_FEATURE_HUMIDITY) &&
-#endif
-          (feature->type != SENSORS_FEATURE_POWER)) {
+      const char *type = sensors_type_name(feature->type);
+      if (type == NULL) {
         DEBUG("sensors plugin: sensors_load_conf: "
               "Ignoring feature `%s', "
               "because its type is not "
@@ -286,6 +441,39 @@ static int sensors_load_conf(void) {
         fl->chip = chip;
         fl->feature = feature;
         fl->subfeature = subfeature;
+        fl->type = type;
+        fl->fd = -1;
+
+        if (sensors_snprintf_chip_name(fl->plugin_instance,
+                                       sizeof(fl->plugin_instance),
+                                       chip) < 0) {
+          sfree(fl);
+          continue;
+        }
+
+        if (use_labels) {
+          char *sensor_label = sensors_get_label(chip, feature);
+          sstrncpy(fl->type_instance, sensor_label, sizeof(fl->type_instance));
+          free(sensor_label);
+        } else {
+          sstrncpy(fl->type_instance, feature->name,
+                   sizeof(fl->type_instance));
+        }
+
+        if (sensor_list != NULL) {
+          char match_key[1024];
+
+          snprintf(match_key, sizeof(match_key), "%s/%s-%s",
+                   fl->plugin_instance, fl->type, fl->type_instance);
+          DEBUG("sensors plugin: Checking ignorelist for `%s'", match_key);
+          if (ignorelist_match(sensor_list, match_key)) {
+            sfree(fl);
+            continue;
+          }
+        }
+
+        if (use_sysfs)
+          sensors_sysfs_open(fl);
 
         if (first_feature == NULL)
           first_feature = fl;
@@ -314,6 +502,7 @@ static int sensors_shutdown(void) {
   return 0;
 } /* int sensors_shutdown */
 
+#if SENSORS_API_VERSION < 0x400
 static void sensors_submit(const char *plugin_instance, const char *type,
                            const char *type_instance, double value) {
   char match_key[1024];
@@ -342,8 +531,52 @@ static void sensors_submit(const char *plugin_instance, const char *type,
 
   plugin_dispatch_values(&vl);
 } /* void sensors_submit */
+/* #endif SENSORS_API_VERSION < 0x400 */
+
+#elif (SENSORS_API_VERSION >= 0x400)
+static void sensors_batch_flush(void) {
+  if (sensors_batch.num == 0)
+    return;
+
+  plugin_dispatch_value_lists(sensors_batch.vls, sensors_batch.num);
+  sensors_batch.num = 0;
+} /* void sensors_batch_flush */
+
+static void sensors_submit(featurelist_t const *fl, double value) {
+  value_list_t *vl = sensors_batch.vls + sensors_batch.num;
+
+  sensors_batch.values[sensors_batch.num].gauge = value;
+
+  *vl = (value_list_t)VALUE_LIST_INIT;
+  vl->values = sensors_batch.values + sensors_batch.num;
+  vl->values_len = 1;
+
+  sstrncpy(vl->plugin, "sensors", sizeof(vl->plugin));
+  sstrncpy(vl->plugin_instance, fl->plugin_instance,
+           sizeof(vl->plugin_instance));
+  sstrncpy(vl->type, fl->type, sizeof(vl->type));
+  sstrncpy(vl->type_instance, fl->type_instance, sizeof(vl->type_instance));
+
+  sensors_batch.num++;
+  if (sensors_batch.num == SENSORS_DISPATCH_BATCH)
+    sensors_batch_flush();
+} /* void sensors_submit */
+
+static void sensors_reload(void) {
+  INFO("sensors plugin: The hwmon devices have changed, reloading the "
+       "sensors.");
+  sensors_free_features();
+  conf_loaded = false;
+} /* void sensors_reload */
+#endif /* (SENSORS_API_VERSION >= 0x400) */
 
 static int sensors_read(void) {
+#if (SENSORS_API_VERSION >= 0x400)
+  if (use_sysfs && conf_loaded &&
+      (sensors_hwmon_signature() != hwmon_signature))
+    sensors_reload();
+#endif
+
   if (sensors_load_conf() != 0)
     return -1;
 
@@ -371,52 +604,30 @@ static int sensors_read(void) {
     /* #endif SENSORS_API_VERSION < 0x400 */
 
 #elif (SENSORS_API_VERSION >= 0x400)
+  bool removed = false;
+
   for (featurelist_t *fl = first_feature; fl != NULL; fl = fl->next) {
     double value;
     int status;
-    char plugin_instance[DATA_MAX_NAME_LEN];
-    char type_instance[DATA_MAX_NAME_LEN];
-    char *sensor_label;
-    const char *type;
-
-    status = sensors_get_value(fl->chip, fl->subfeature->number, &value);
-    if (status < 0)
-      continue;
-
-    status = sensors_snprintf_chip_name(plugin_instance,
-                                        sizeof(plugin_instance), fl->chip);
-    if (status < 0)
-      continue;
 
-    if (use_labels) {
-      sensor_label = sensors_get_label(fl->chip, fl->feature);
-      sstrncpy(type_instance, sensor_label, sizeof(type_instance));
-      free(sensor_label);
+    if (fl->fd >= 0) {
+      status = sensors_sysfs_read(fl, &value);
+      /* The device has been removed. */
+      if ((status != 0) && (errno == ENODEV))
+        removed = true;
     } else {
-      sstrncpy(type_instance, fl->feature->name, sizeof(type_instance));
+      status = sensors_get_value(fl->chip, fl->subfeature->number, &value);
     }
-
-    if (fl->feature->type == SENSORS_FEATURE_IN)
-      type = "voltage";
-    else if (fl->feature->type == SENSORS_FEATURE_FAN)
-      type = "fanspeed";
-    else if (fl->feature->type == SENSORS_FEATURE_TEMP)
-      type = "temperature";
-    else if (fl->feature->type == SENSORS_FEATURE_POWER)
-      type = "power";
-#if SENSORS_API_VERSION >= 0x402
-    else if (fl->feature->type == SENSORS_FEATURE_CURR)
-      type = "current";
-#endif
-#if SENSORS_API_VERSION >= 0x431
-    else if (fl->feature->type == SENSORS_FEATURE_HUMIDITY)
-      type = "humidity";
-#endif
-    else
+    if (status < 0)
       continue;
 
-    sensors_submit(plugin_instance, type, type_instance, value);
+    sensors_submit(fl, value);
   } /* for fl = first_feature .. NULL */
+
+  sensors_batch_flush();
+
+  if (removed)
+    sensors_reload();
 #endif /* (SENSORS_API_VERSION >= 0x400) */
 
   return 0;
@@ -0,0 +1,371 @@
+/**
+ * collectd - src/shm_ring.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+/*
+ * Receives values from local producers through shared memory rings, see
+ * src/libcollectdclient/collectd/shm_format.h. Producers write fixed size
+ * records with lcc_shm_ring_putval(), which costs no system call and no
+ * parsing; a thread of this plugin drains all rings and dispatches the values
+ * in batches.
+ */
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils/common/common.h"
+#include "utils/shm/shm.h"
+
+#include "collectd/shm_format.h"
+
+#include <signal.h>
+#include <sys/stat.h>
+
+#define SR_DEFAULT_RINGS 16
+#define SR_DEFAULT_RING_SIZE 1024
+#define SR_DEFAULT_BATCH_SIZE 256
+#define SR_DEFAULT_POLL_INTERVAL MS_TO_CDTIME_T(10)
+
+/* How often to look for producers that exited while holding a ring and to
+ * report dropped values. */
+#define SR_MAINTENANCE_INTERVAL TIME_T_TO_CDTIME_T(10)
+
+static char *sr_name;
+static char *sr_group;
+static int sr_perms = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
+static int sr_rings = SR_DEFAULT_RINGS;
+static int sr_ring_size = SR_DEFAULT_RING_SIZE;
+static int sr_batch_size = SR_DEFAULT_BATCH_SIZE;
+static cdtime_t sr_poll_interval = SR_DEFAULT_POLL_INTERVAL;
+
+static void *sr_addr;
+static size_t sr_size;
+static lcc_shm_ring_ctl_t *sr_ctls;
+static unsigned char *sr_records;
+static uint64_t *sr_dropped;
+
+static value_list_t *sr_batch;
+static value_t *sr_batch_values;
+static size_t sr_batch_num;
+
+static pthread_mutex_t sr_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sr_cond = PTHREAD_COND_INITIALIZER;
+static bool sr_loop;
+static pthread_t sr_thread;
+static bool sr_thread_running;
+
+static char const *sr_segment_name(void) {
+  return (sr_name != NULL) ? sr_name : LCC_SHM_RING_DEFAULT_NAME;
+}
+
+static lcc_shm_record_t *sr_record(size_t ring, uint64_t pos) {
+  size_t index = ring * (size_t)sr_ring_size +
+                 (size_t)(pos & (uint64_t)(sr_ring_size - 1));
+  return (lcc_shm_record_t *)(sr_records + index * sizeof(lcc_shm_record_t));
+}
+
+static void sr_batch_flush(void) /* {{{ */
+{
+  if (sr_batch_num == 0)
+    return;
+
+  int failed = plugin_dispatch_value_lists(sr_batch, sr_batch_num);
+  if (failed != 0)
+    WARNING("shm_ring plugin: Dispatching %d of %" PRIsz " value lists failed.",
+            failed, sr_batch_num);
+
+  sr_batch_num = 0;
+} /* }}} void sr_batch_flush */
+
+/* Copies the record to the batch. Producers are not trusted to terminate
+ * strings or to stay within bounds. */
+static void sr_batch_add(lcc_shm_record_t const *r) /* {{{ */
+{
+  if (sr_batch_num >= (size_t)sr_batch_size)
+    sr_batch_flush();
+
+  value_list_t *vl = sr_batch + sr_batch_num;
+  value_t *values = sr_batch_values + sr_batch_num * LCC_SHM_VALUES_MAX;
+
+  *vl = (value_list_t)VALUE_LIST_INIT;
+  vl->values = values;
+  vl->values_len = r->values_num;
+  if (vl->values_len > LCC_SHM_VALUES_MAX)
+    vl->values_len = LCC_SHM_VALUES_MAX;
+  memcpy(values, r->values, vl->values_len * sizeof(*values));
+
+  if (r->time > 0)
+    vl->time = DOUBLE_TO_CDTIME_T(r->time);
+  if (r->interval > 0)
+    vl->interval = DOUBLE_TO_CDTIME_T(r->interval);
+
+  sstrncpy(vl->host, r->host, sizeof(r->host));
+  sstrncpy(vl->plugin, r->plugin, sizeof(r->plugin));
+  sstrncpy(vl->plugin_instance, r->plugin_instance,
+           sizeof(r->plugin_instance));
+  sstrncpy(vl->type, r->type, sizeof(r->type));
+  sstrncpy(vl->type_instance, r->type_instance, sizeof(r->type_instance));
+
+  if ((vl->plugin[0] == 0) || (vl->type[0] == 0))
+    return;
+  sr_batch_num++;
+} /* }}} void sr_batch_add */
+
+/* Returns the number of records read from ring "index". */
+static uint64_t sr_drain(size_t index) /* {{{ */
+{
+  lcc_shm_ring_ctl_t *ctl = sr_ctls + index;
+
+  /* Only this thread writes "tail". */
+  uint64_t tail = __atomic_load_n(&ctl->tail, __ATOMIC_RELAXED);
+  uint64_t head = __atomic_load_n(&ctl->head, __ATOMIC_ACQUIRE);
+  if (head - tail > (uint64_t)sr_ring_size) {
+    /* Only a broken producer gets here: skip what it claims to have written
+     * beyond the ring. */
+    tail = head - (uint64_t)sr_ring_size;
+  }
+
+  uint64_t num = head - tail;
+  for (; tail != head; tail++)
+    sr_batch_add(sr_record(index, tail));
+
+  /* The records have been copied, so the producer may reuse them. */
+  __atomic_store_n(&ctl->tail, tail, __ATOMIC_RELEASE);
+  return num;
+} /* }}} uint64_t sr_drain */
+
+static void sr_maintenance(void) /* {{{ */
+{
+  uint64_t dropped = 0;
+
+  for (size_t i = 0; i < (size_t)sr_rings; i++) {
+    lcc_shm_ring_ctl_t *ctl = sr_ctls + i;
+
+    uint64_t d = __atomic_load_n(&ctl->dropped, __ATOMIC_RELAXED);
+    dropped += d - sr_dropped[i];
+    sr_dropped[i] = d;
+
+    uint32_t owner = __atomic_load_n(&ctl->owner, __ATOMIC_ACQUIRE);
+    if ((owner == 0) || (kill((pid_t)owner, 0) == 0) || (errno != ESRCH))
+      continue;
+
+    /* Records the producer wrote before exiting have been or will be read as
+     * usual; the next producer continues at "head". */
+    if (__atomic_compare_exchange_n(&ctl->owner, &owner, 0, /* weak = */ false,
+                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      NOTICE("shm_ring plugin: Process %" PRIu32 " exited without releasing "
+             "ring %" PRIsz ", releasing it.",
+             owner, i);
+  }
+
+  if (dropped > 0)
+    WARNING("shm_ring plugin: Producers dropped %" PRIu64 " values because "
+            "their rings were full. Consider increasing \"RingSize\".",
+            dropped);
+} /* }}} void sr_maintenance */
+
+static void *sr_thread_main(__attribute__((unused)) void *arg) /* {{{ */
+{
+  cdtime_t next_maintenance = cdtime() + SR_MAINTENANCE_INTERVAL;
+
+  pthread_mutex_lock(&sr_lock);
+  while (42) {
+    bool loop = sr_loop;
+    pthread_mutex_unlock(&sr_lock);
+
+    uint64_t num = 0;
+    for (size_t i = 0; i < (size_t)sr_rings; i++)
+      num += sr_drain(i);
+    sr_batch_flush();
+
+    cdtime_t now = cdtime();
+    if (now >= next_maintenance) {
+      sr_maintenance();
+      next_maintenance = now + SR_MAINTENANCE_INTERVAL;
+    }
+
+    pthread_mutex_lock(&sr_lock);
+    /* Drain once more after shutdown was requested. */
+    if (!loop)
+      break;
+    if ((num == 0) && sr_loop) {
+      struct timespec ts = CDTIME_T_TO_TIMESPEC(now + sr_poll_interval);
+      pthread_cond_timedwait(&sr_cond, &sr_lock, &ts);
+    }
+  }
+  pthread_mutex_unlock(&sr_lock);
+
+  return NULL;
+} /* }}} void *sr_thread_main */
+
+static int sr_init(void) /* {{{ */
+{
+  if (sr_addr != NULL)
+    return 0;
+
+  sr_batch = calloc((size_t)sr_batch_size, sizeof(*sr_batch));
+  sr_batch_values = calloc((size_t)sr_batch_size * LCC_SHM_VALUES_MAX,
+                           sizeof(*sr_batch_values));
+  sr_dropped = calloc((size_t)sr_rings, sizeof(*sr_dropped));
+  if ((sr_batch == NULL) || (sr_batch_values == NULL) || (sr_dropped == NULL)) {
+    ERROR("shm_ring plugin: calloc failed.");
+    return -1;
+  }
+
+  size_t size = sizeof(lcc_shm_ring_header_t) +
+                (size_t)sr_rings * (sizeof(lcc_shm_ring_ctl_t) +
+                                    (size_t)sr_ring_size *
+                                        sizeof(lcc_shm_record_t));
+  void *addr = cu_shm_create(sr_segment_name(), LCC_SHM_RING_MAGIC, size,
+                             sr_perms, sr_group);
+  if (addr == NULL)
+    return -1;
+
+  lcc_shm_ring_header_t *h = addr;
+  h->magic = LCC_SHM_RING_MAGIC;
+  h->version = LCC_SHM_RING_VERSION;
+  h->rings_num = (uint32_t)sr_rings;
+  h->ring_size = (uint32_t)sr_ring_size;
+  h->record_size = (uint32_t)sizeof(lcc_shm_record_t);
+
+  sr_addr = addr;
+  sr_size = size;
+  sr_ctls = (lcc_shm_ring_ctl_t *)(h + 1);
+  sr_records = (unsigned char *)(sr_ctls + sr_rings);
+
+  sr_loop = true;
+  int status = plugin_thread_create(&sr_thread, sr_thread_main, NULL,
+                                    "shm_ring");
+  if (status != 0) {
+    ERROR("shm_ring plugin: Starting thread failed: %s", STRERROR(status));
+    cu_shm_destroy(sr_segment_name(), sr_addr, sr_size);
+    sr_addr = NULL;
+    return -1;
+  }
+  sr_thread_running = true;
+
+  /* Let producers in only once everything is set up. */
+  __atomic_store_n(&h->state, LCC_SHM_STATE_OPEN, __ATOMIC_RELEASE);
+
+  INFO("shm_ring plugin: Receiving values in %s: %d rings of %d records "
+       "(%zu bytes).",
+       sr_segment_name(), sr_rings, sr_ring_size, size);
+  return 0;
+} /* }}} int sr_init */
+
+static int sr_shutdown(void) /* {{{ */
+{
+  if (sr_thread_running) {
+    pthread_mutex_lock(&sr_lock);
+    sr_loop = false;
+    pthread_cond_signal(&sr_cond);
+    pthread_mutex_unlock(&sr_lock);
+
+    pthread_join(sr_thread, NULL);
+    sr_thread_running = false;
+  }
+
+  if (sr_addr != NULL) {
+    cu_shm_destroy(sr_segment_name(), sr_addr, sr_size);
+    sr_addr = NULL;
+  }
+
+  sfree(sr_batch);
+  sfree(sr_batch_values);
+  sfree(sr_dropped);
+  sfree(sr_name);
+  sfree(sr_group);
+  return 0;
+} /* }}} int sr_shutdown */
+
+static int sr_config_positive(oconfig_item_t *child, int *ret) /* {{{ */
+{
+  int status = cf_util_get_int(child, ret);
+  if ((status == 0) && (*ret < 1)) {
+    ERROR("shm_ring plugin: %s must be positive.", child->key);
+    return -1;
+  }
+  return status;
+} /* }}} int sr_config_positive */
+
+static int sr_config(oconfig_item_t *ci) /* {{{ */
+{
+  for (int i = 0; i < ci->children_num; i++) {
+    oconfig_item_t *child = ci->children + i;
+    int status = 0;
+
+    if (strcasecmp("Name", child->key) == 0) {
+      status = cf_util_get_string(child, &sr_name);
+      if ((status == 0) &&
+          ((sr_name[0] != '/') || (strchr(sr_name + 1, '/') != NULL))) {
+        ERROR("shm_ring plugin: Name must start with a slash and contain no "
+              "other slashes.");
+        status = -1;
+      }
+    } else if (strcasecmp("Group", child->key) == 0) {
+      status = cf_util_get_string(child, &sr_group);
+    } else if (strcasecmp("Permissions", child->key) == 0) {
+      char *perms = NULL;
+      status = cf_util_get_string(child, &perms);
+      if (status == 0)
+        sr_perms = (int)strtol(perms, NULL, 8);
+      sfree(perms);
+    } else if (strcasecmp("Rings", child->key) == 0) {
+      status = sr_config_positive(child, &sr_rings);
+    } else if (strcasecmp("RingSize", child->key) == 0) {
+      status = sr_config_positive(child, &sr_ring_size);
+      if ((status == 0) && (sr_ring_size > (1 << 24))) {
+        ERROR("shm_ring plugin: RingSize must be at most %d.", 1 << 24);
+        status = -1;
+      }
+      if (status == 0) {
+        /* Rings need a power of two, so that their counters may wrap. */
+        int size = 1;
+        while (size < sr_ring_size)
+          size <<= 1;
+        sr_ring_size = size;
+      }
+    } else if (strcasecmp("BatchSize", child->key) == 0) {
+      status = sr_config_positive(child, &sr_batch_size);
+    } else if (strcasecmp("PollInterval", child->key) == 0) {
+      status = cf_util_get_cdtime(child, &sr_poll_interval);
+      if ((status == 0) && (sr_poll_interval == 0)) {
+        ERROR("shm_ring plugin: PollInterval must be positive.");
+        status = -1;
+      }
+    } else {
+      ERROR("shm_ring plugin: Unknown config option: %s", child->key);
+      status = -1;
+    }
+
+    if (status != 0)
+      return status;
+  }
+
+  return 0;
+} /* }}} int sr_config */
+
+void module_register(void) {
+  plugin_register_complex_config("shm_ring", sr_config);
+  plugin_register_init("shm_ring", sr_init);
+  plugin_register_shutdown("shm_ring", sr_shutdown);
+}
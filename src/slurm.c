@@ -380,16 +380,24 @@ static partition_state_t *alloc_partition_states(uint32_t num_partitions,
   return partition_states;
 }
 
+static int partition_state_cmp(const void *a, const void *b) {
+  const partition_state_t *pa = a;
+  const partition_state_t *pb = b;
+
+  return strncmp(pa->name, pb->name, PART_NAME_SIZE);
+}
+
+/* partitions must be sorted by name, see partition_state_cmp() */
 static partition_state_t *find_partition(partition_state_t *partitions,
                                          uint32_t num_partitions, char *name) {
-  partition_state_t *part = NULL;
+  partition_state_t key;
 
-  for (int i = 0; i < num_partitions; i++) {
-    if (strncmp(name, partitions[i].name, PART_NAME_SIZE) == 0)
-      part = &partitions[i];
-  }
+  if (name == NULL)
+    return NULL;
 
-  return part;
+  sstrncpy(key.name, name, sizeof(key.name));
+  return bsearch(&key, partitions, num_partitions, sizeof(*partitions),
+                 partition_state_cmp);
 }
 
 static void slurm_submit_gauge(const char *plugin_instance, const char *type,
@@ -506,63 +514,146 @@ static void slurm_submit_stats(stats_info_response_msg_t *stats_resp) {
                       "backfill_queue_length", stats_resp->bf_queue_len_sum);
 }
 
-static int slurm_read(void) {
-  job_info_msg_t *job_buffer_ptr = NULL;
-  job_info_t *job_ptr;
-  partition_info_msg_t *part_buffer_ptr = NULL;
-  partition_info_t *part_ptr;
-  partition_state_t *partition_states;
-  partition_state_t *partition_state;
-  node_info_msg_t *node_buffer_ptr = NULL;
-  node_info_t *node_ptr;
-  stats_info_response_msg_t *stats_resp;
-  stats_info_request_msg_t stats_req;
-
-  if (slurm_load_jobs((time_t)NULL, &job_buffer_ptr, SHOW_ALL)) {
-    ERROR(PLUGIN_NAME ": slurm_load_jobs error");
+/* Messages of the previous read. Their last_update time is handed back to
+ * slurmctld, which only sends the table again if it has changed since. */
+static job_info_msg_t *job_cache;
+static node_info_msg_t *node_cache;
+static partition_info_msg_t *part_cache;
+
+static int slurm_load_cached_jobs(void) {
+  job_info_msg_t *msg = NULL;
+  time_t last_update = (job_cache != NULL) ? job_cache->last_update : 0;
+
+  if (slurm_load_jobs(last_update, &msg, SHOW_ALL) != SLURM_SUCCESS) {
+    if ((job_cache != NULL) && (slurm_get_errno() == SLURM_NO_CHANGE_IN_DATA))
+      return 0;
+    ERROR(PLUGIN_NAME ": slurm_load_jobs error: %s",
+          slurm_strerror(slurm_get_errno()));
     return -1;
   }
 
-  if (slurm_load_node((time_t)NULL, &node_buffer_ptr, SHOW_ALL)) {
-    slurm_free_job_info_msg(job_buffer_ptr);
-    ERROR(PLUGIN_NAME ": slurm_load_node error");
+  if (job_cache != NULL)
+    slurm_free_job_info_msg(job_cache);
+  job_cache = msg;
+  return 0;
+}
+
+static int slurm_load_cached_nodes(void) {
+  node_info_msg_t *msg = NULL;
+  time_t last_update = (node_cache != NULL) ? node_cache->last_update : 0;
+
+  if (slurm_load_node(last_update, &msg, SHOW_ALL) != SLURM_SUCCESS) {
+    if ((node_cache != NULL) && (slurm_get_errno() == SLURM_NO_CHANGE_IN_DATA))
+      return 0;
+    ERROR(PLUGIN_NAME ": slurm_load_node error: %s",
+          slurm_strerror(slurm_get_errno()));
     return -1;
   }
 
-  if (slurm_load_partitions((time_t)NULL, &part_buffer_ptr, 0)) {
-    slurm_free_job_info_msg(job_buffer_ptr);
-    slurm_free_node_info_msg(node_buffer_ptr);
-    ERROR(PLUGIN_NAME ": slurm_load_partitions error");
+  if (node_cache != NULL)
+    slurm_free_node_info_msg(node_cache);
+  node_cache = msg;
+  return 0;
+}
+
+static int slurm_load_cached_partitions(void) {
+  partition_info_msg_t *msg = NULL;
+  time_t last_update = (part_cache != NULL) ? part_cache->last_update : 0;
+
+  if (slurm_load_partitions(last_update, &msg, 0) != SLURM_SUCCESS) {
+    if ((part_cache != NULL) && (slurm_get_errno() == SLURM_NO_CHANGE_IN_DATA))
+      return 0;
+    ERROR(PLUGIN_NAME ": slurm_load_partitions error: %s",
+          slurm_strerror(slurm_get_errno()));
     return -1;
   }
 
+  if (part_cache != NULL)
+    slurm_free_partition_info_msg(part_cache);
+  part_cache = msg;
+  return 0;
+}
+
+static void *slurm_load_jobs_thread(void *arg) {
+  *(int *)arg = slurm_load_cached_jobs();
+  return NULL;
+}
+
+static void *slurm_load_nodes_thread(void *arg) {
+  *(int *)arg = slurm_load_cached_nodes();
+  return NULL;
+}
+
+static int slurm_read(void) {
+  job_info_t *job_ptr;
+  partition_info_t *part_ptr;
+  partition_state_t *partition_states;
+  partition_state_t *partition_state;
+  node_info_t *node_ptr;
+  stats_info_response_msg_t *stats_resp = NULL;
+  stats_info_request_msg_t stats_req;
+  pthread_t jobs_thread;
+  pthread_t nodes_thread;
+  int jobs_status = -1;
+  int nodes_status = -1;
+  int part_status;
+  int stats_status;
+
+  /* The four RPCs are independent of each other, so the job and node tables
+   * are fetched in helper threads while this thread takes care of the
+   * partitions and statistics. Fall back to loading them here if a thread
+   * cannot be started. */
+  bool jobs_threaded =
+      (plugin_thread_create(&jobs_thread, slurm_load_jobs_thread, &jobs_status,
+                            "slurm jobs") == 0);
+  if (!jobs_threaded)
+    jobs_status = slurm_load_cached_jobs();
+
+  bool nodes_threaded =
+      (plugin_thread_create(&nodes_thread, slurm_load_nodes_thread,
+                            &nodes_status, "slurm nodes") == 0);
+  if (!nodes_threaded)
+    nodes_status = slurm_load_cached_nodes();
+
+  part_status = slurm_load_cached_partitions();
+
   stats_req.command_id = STAT_COMMAND_GET;
-  if (slurm_get_statistics(&stats_resp, &stats_req)) {
-    slurm_free_job_info_msg(job_buffer_ptr);
-    slurm_free_node_info_msg(node_buffer_ptr);
-    slurm_free_partition_info_msg(part_buffer_ptr);
-    ERROR(PLUGIN_NAME ": slurm_get_statistics error");
+  stats_status = slurm_get_statistics(&stats_resp, &stats_req);
+  if (stats_status != SLURM_SUCCESS)
+    ERROR(PLUGIN_NAME ": slurm_get_statistics error: %s",
+          slurm_strerror(slurm_get_errno()));
+
+  if (jobs_threaded)
+    pthread_join(jobs_thread, NULL);
+  if (nodes_threaded)
+    pthread_join(nodes_thread, NULL);
+
+  if ((jobs_status != 0) || (nodes_status != 0) || (part_status != 0) ||
+      (stats_status != SLURM_SUCCESS)) {
+    if (stats_status == SLURM_SUCCESS)
+      slurm_free_stats_response_msg(stats_resp);
+    return -1;
   }
 
   /* SLURM APIs provide *non-relational* data about nodes, partitions and jobs.
    * We allocate a data structure that relates all three together, and the
-   * following
-   * two for loops fill this data structure. The data structure is an array
-   * of partition_state_t that holds job and node states. */
-  uint32_t num_partitions = part_buffer_ptr->record_count;
+   * following two for loops fill this data structure. The data structure is
+   * an array of partition_state_t, sorted by name, that holds job and node
+   * states. */
+  uint32_t num_partitions = part_cache->record_count;
   partition_states =
-      alloc_partition_states(num_partitions, part_buffer_ptr->partition_array);
+      alloc_partition_states(num_partitions, part_cache->partition_array);
   if (!partition_states) {
-    slurm_free_job_info_msg(job_buffer_ptr);
-    slurm_free_node_info_msg(node_buffer_ptr);
-    slurm_free_partition_info_msg(part_buffer_ptr);
+    slurm_free_stats_response_msg(stats_resp);
     ERROR(PLUGIN_NAME ": alloc_partition_states");
     return -1;
   }
+  qsort(partition_states, num_partitions, sizeof(*partition_states),
+        partition_state_cmp);
 
   /* fill partition_states array with per-partition job state information */
-  for (int i = 0; i < job_buffer_ptr->record_count; i++) {
-    job_ptr = &job_buffer_ptr->job_array[i];
+  for (int i = 0; i < job_cache->record_count; i++) {
+    job_ptr = &job_cache->job_array[i];
     partition_state =
         find_partition(partition_states, num_partitions, job_ptr->partition);
     if (!partition_state) {
@@ -573,12 +664,13 @@ static int slurm_read(void) {
     }
 
     uint8_t job_state = job_ptr->job_state & JOB_STATE_BASE;
-    partition_state->jobs_states_count[job_state]++;
+    if (job_state < JOB_END)
+      partition_state->jobs_states_count[job_state]++;
   }
 
   /* fill partition_states array with per-partition node state information */
-  for (int i = 0; i < part_buffer_ptr->record_count; i++) {
-    part_ptr = &part_buffer_ptr->partition_array[i];
+  for (int i = 0; i < part_cache->record_count; i++) {
+    part_ptr = &part_cache->partition_array[i];
 
     partition_state =
         find_partition(partition_states, num_partitions, part_ptr->name);
@@ -593,7 +685,9 @@ static int slurm_read(void) {
       if (part_ptr->node_inx[j] == -1)
         break;
       for (int k = part_ptr->node_inx[j]; k <= part_ptr->node_inx[j + 1]; k++) {
-        node_ptr = &node_buffer_ptr->node_array[k];
+        if (k >= node_cache->record_count)
+          break;
+        node_ptr = &node_cache->node_array[k];
         /* some non-existant nodes (name is NULL) may show up as node_state
          * FUTURE */
         uint8_t node_state = slurm_node_state(node_ptr->node_state);
@@ -607,12 +701,25 @@ static int slurm_read(void) {
 
   slurm_submit_stats(stats_resp);
 
-  slurm_free_job_info_msg(job_buffer_ptr);
-  slurm_free_node_info_msg(node_buffer_ptr);
-  slurm_free_partition_info_msg(part_buffer_ptr);
   slurm_free_stats_response_msg(stats_resp);
   free(partition_states);
   return 0;
 }
 
-void module_register(void) { plugin_register_read("slurm", slurm_read); }
+static int slurm_shutdown(void) {
+  if (job_cache != NULL)
+    slurm_free_job_info_msg(job_cache);
+  if (node_cache != NULL)
+    slurm_free_node_info_msg(node_cache);
+  if (part_cache != NULL)
+    slurm_free_partition_info_msg(part_cache);
+  job_cache = NULL;
+  node_cache = NULL;
+  part_cache = NULL;
+  return 0;
+}
+
+void module_register(void) {
+  plugin_register_read("slurm", slurm_read);
+  plugin_register_shutdown("slurm", slurm_shutdown);
+}
@@ -31,6 +31,7 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/heap/heap.h"
 #include "utils/ignorelist/ignorelist.h"
 
 #include <atasmart.h>
@@ -57,20 +58,70 @@ struct nvme_admin_cmd {
   __u32 data_len;
   __u32 cdw10;
   __u32 cdw11;
-  __u8 rsvd4[24];
+  __u32 cdw12;
+  __u32 cdw13;
+  __u32 cdw14;
+  __u32 cdw15;
+  __u32 timeout_ms;
+  __u32 result;
 };
 
 #define NVME_IOCTL_ADMIN_CMD _IOWR('N', 0x41, struct nvme_admin_cmd)
 
-static const char *config_keys[] = {"Disk", "IgnoreSelected", "IgnoreSleepMode",
-                                    "UseSerial"};
+static const char *config_keys[] = {"Disk",      "IgnoreSelected",
+                                    "IgnoreSleepMode", "UseSerial",
+                                    "Threads",   "Timeout"};
 
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
+#define SMART_DEFAULT_THREADS 4
+#define SMART_DEFAULT_TIMEOUT TIME_T_TO_CDTIME_T(10)
+/* Disks that take longer than the timeout are polled less often, up to once
+ * every this many intervals. */
+#define SMART_MAX_BACKOFF 8
+
+/* A disk found by udev. The device is opened on the first poll and stays
+ * open. Disks are polled by a pool of worker threads, each disk on its own
+ * schedule. A disk that disappears is unlinked from "disks" and marked
+ * "removed"; the worker that takes it from the schedule next frees it. */
+struct smart_disk_s {
+  char *syspath;
+  char *dev;
+  char *name;
+
+  bool nvme;
+  int fd;        /* NVMe */
+  int vendor_id; /* NVMe */
+  SkDisk *sk;    /* SATA */
+
+  int backoff;
+  bool seen;
+  bool removed;
+  struct smart_disk_s *next;
+};
+typedef struct smart_disk_s smart_disk_t;
+
 static ignorelist_t *ignorelist, *ignorelist_by_serial;
 static int ignore_sleep_mode;
 static int use_serial;
 static int invert_ignorelist;
+static int conf_threads = SMART_DEFAULT_THREADS;
+static cdtime_t conf_timeout = SMART_DEFAULT_TIMEOUT;
+
+static struct udev *handle_udev;
+static struct udev_monitor *monitor;
+
+/* Protects "disks", "schedule" and the disks' "removed" flags. */
+static pthread_mutex_t disks_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t disks_cond = PTHREAD_COND_INITIALIZER;
+static smart_disk_t *disks;
+static size_t disks_added;
+static c_timeheap_t *schedule;
+static cdtime_t poll_interval;
+
+static pthread_t *workers;
+static size_t workers_num;
+static bool workers_shutdown;
 
 static int smart_config(const char *key, const char *value) {
   if (ignorelist == NULL)
@@ -91,6 +142,20 @@ static int smart_config(const char *key, const char *value) {
   } else if (strcasecmp("UseSerial", key) == 0) {
     if (IS_TRUE(value))
       use_serial = 1;
+  } else if (strcasecmp("Threads", key) == 0) {
+    int tmp = atoi(value);
+    if (tmp < 1) {
+      ERROR("smart plugin: \"Threads\" must be positive.");
+      return 1;
+    }
+    conf_threads = tmp;
+  } else if (strcasecmp("Timeout", key) == 0) {
+    double tmp = atof(value);
+    if (tmp <= 0.0) {
+      ERROR("smart plugin: \"Timeout\" must be positive.");
+      return 1;
+    }
+    conf_timeout = DOUBLE_TO_CDTIME_T(tmp);
   } else {
     return -1;
   }
@@ -268,44 +333,32 @@ static void smart_nvme_submit_16b(char const *name, __u8 *raw) {
   }
 }
 
-static int get_vendor_id(const char *dev, char const *name) {
+static int get_vendor_id(int fd, char const *name) {
 
-  int fd, err;
+  int err;
   __le16 vid;
 
-  fd = open(dev, O_RDWR);
-  if (fd < 0) {
-    ERROR("open failed with %s\n", strerror(errno));
-    return fd;
-  }
-
   err = ioctl(fd, NVME_IOCTL_ADMIN_CMD,
-              &(struct nvme_admin_cmd){.opcode = NVME_ADMIN_IDENTIFY,
-                                       .nsid = NVME_NSID_ALL,
-                                       .addr = (unsigned long)&vid,
-                                       .data_len = sizeof(vid),
-                                       .cdw10 = 1,
-                                       .cdw11 = 0});
+              &(struct nvme_admin_cmd){
+                  .opcode = NVME_ADMIN_IDENTIFY,
+                  .nsid = NVME_NSID_ALL,
+                  .addr = (unsigned long)&vid,
+                  .data_len = sizeof(vid),
+                  .cdw10 = 1,
+                  .cdw11 = 0,
+                  .timeout_ms = (__u32)CDTIME_T_TO_MS(conf_timeout)});
 
   if (err < 0) {
     ERROR("ioctl for NVME_IOCTL_ADMIN_CMD failed with %s\n", strerror(errno));
-    close(fd);
     return err;
   }
 
-  close(fd);
   return (int)le16_to_cpu(vid);
 }
 
-static int smart_read_nvme_disk(const char *dev, char const *name) {
+static int smart_read_nvme_disk(int fd, char const *name) {
   union nvme_smart_log smart_log = {};
-  int fd, status;
-
-  fd = open(dev, O_RDWR);
-  if (fd < 0) {
-    ERROR("open failed with %s\n", strerror(errno));
-    return fd;
-  }
+  int status;
 
   /**
    * Prepare Get Log Page command
@@ -316,14 +369,15 @@ static int smart_read_nvme_disk(const char *dev, char const *name) {
    */
 
   status = ioctl(fd, NVME_IOCTL_ADMIN_CMD,
-                 &(struct nvme_admin_cmd){.opcode = NVME_ADMIN_GET_LOG_PAGE,
-                                          .nsid = NVME_NSID_ALL,
-                                          .addr = (unsigned long)&smart_log,
-                                          .data_len = sizeof(smart_log),
-                                          .cdw10 = NVME_SMART_CDW10});
+                 &(struct nvme_admin_cmd){
+                     .opcode = NVME_ADMIN_GET_LOG_PAGE,
+                     .nsid = NVME_NSID_ALL,
+                     .addr = (unsigned long)&smart_log,
+                     .data_len = sizeof(smart_log),
+                     .cdw10 = NVME_SMART_CDW10,
+                     .timeout_ms = (__u32)CDTIME_T_TO_MS(conf_timeout)});
   if (status < 0) {
     ERROR("ioctl for NVME_IOCTL_ADMIN_CMD failed with %s\n", strerror(errno));
-    close(fd);
     return status;
   } else {
     smart_submit(name, "nvme_critical_warning", "",
@@ -370,38 +424,31 @@ static int smart_read_nvme_disk(const char *dev, char const *name) {
     smart_nvme_submit_16b(name, smart_log.raw);
   }
 
-  close(fd);
   return 0;
 }
 
-static int smart_read_nvme_intel_disk(const char *dev, char const *name) {
+static int smart_read_nvme_intel_disk(int fd, char const *name) {
 
   DEBUG("name = %s", name);
-  DEBUG("dev = %s", dev);
 
   struct nvme_additional_smart_log intel_smart_log;
-  int fd, status;
-  fd = open(dev, O_RDWR);
-  if (fd < 0) {
-    ERROR("open failed with %s\n", strerror(errno));
-    return fd;
-  }
+  int status;
 
   /**
    * Prepare Get Log Page command
    * - Additional SMART Attributes (Log Identfiter CAh)
    */
 
-  status =
-      ioctl(fd, NVME_IOCTL_ADMIN_CMD,
-            &(struct nvme_admin_cmd){.opcode = NVME_ADMIN_GET_LOG_PAGE,
-                                     .nsid = NVME_NSID_ALL,
-                                     .addr = (unsigned long)&intel_smart_log,
-                                     .data_len = sizeof(intel_smart_log),
-                                     .cdw10 = NVME_SMART_INTEL_CDW10});
+  status = ioctl(fd, NVME_IOCTL_ADMIN_CMD,
+                 &(struct nvme_admin_cmd){
+                     .opcode = NVME_ADMIN_GET_LOG_PAGE,
+                     .nsid = NVME_NSID_ALL,
+                     .addr = (unsigned long)&intel_smart_log,
+                     .data_len = sizeof(intel_smart_log),
+                     .cdw10 = NVME_SMART_INTEL_CDW10,
+                     .timeout_ms = (__u32)CDTIME_T_TO_MS(conf_timeout)});
   if (status < 0) {
     ERROR("ioctl for NVME_IOCTL_ADMIN_CMD failed with %s\n", strerror(errno));
-    close(fd);
     return status;
   } else {
 
@@ -473,7 +520,6 @@ static int smart_read_nvme_intel_disk(const char *dev, char const *name) {
                  int48_to_double(intel_smart_log.host_bytes_written.raw));
   }
 
-  close(fd);
   return 0;
 }
 
@@ -534,76 +580,228 @@ static void smart_read_sata_disk(SkDisk *d, char const *name) {
   }
 }
 
-static void smart_handle_disk(const char *dev, const char *serial) {
-  SkDisk *d = NULL;
+/* Returns the name disk "dev" is reported as, or NULL if it is ignored. */
+static const char *smart_disk_name(const char *dev, const char *serial) {
   const char *name;
-  int err;
 
   if (use_serial && serial) {
     name = serial;
   } else {
     name = strrchr(dev, '/');
     if (!name)
-      return;
+      return NULL;
     name++;
   }
 
   if (use_serial) {
     if (ignorelist_match(ignorelist_by_serial, name) != 0) {
       DEBUG("smart plugin: ignoring %s. Name = %s", dev, name);
-      return;
+      return NULL;
     }
   } else {
     if (ignorelist_match(ignorelist, name) != 0) {
       DEBUG("smart plugin: ignoring %s. Name = %s", dev, name);
-      return;
+      return NULL;
     }
   }
 
-  DEBUG("smart plugin: checking SMART status of %s.", dev);
+  return name;
+}
+
+static void smart_disk_free(smart_disk_t *disk) {
+  if (disk == NULL)
+    return;
+
+  if (disk->fd >= 0)
+    close(disk->fd);
+  if (disk->sk != NULL)
+    sk_disk_free(disk->sk);
 
-  if (strstr(dev, "nvme")) {
-    err = smart_read_nvme_disk(dev, name);
+  sfree(disk->syspath);
+  sfree(disk->dev);
+  sfree(disk->name);
+  sfree(disk);
+}
+
+/* Reads the SMART data of one disk. Called by the workers without holding
+ * "disks_lock": a disk is only polled by the worker that took it from the
+ * schedule. */
+static void smart_disk_poll(smart_disk_t *disk) {
+  int err;
+
+  DEBUG("smart plugin: checking SMART status of %s.", disk->dev);
+
+  if (disk->nvme) {
+    if (disk->fd < 0) {
+      disk->fd = open(disk->dev, O_RDWR);
+      if (disk->fd < 0) {
+        ERROR("smart plugin: open(%s) failed: %s", disk->dev, STRERRNO);
+        return;
+      }
+      disk->vendor_id = get_vendor_id(disk->fd, disk->name);
+    }
+
+    err = smart_read_nvme_disk(disk->fd, disk->name);
     if (err) {
       ERROR("smart plugin: smart_read_nvme_disk failed, %d", err);
-    } else {
-      switch (get_vendor_id(dev, name)) {
-      case INTEL_VENDOR_ID:
-        err = smart_read_nvme_intel_disk(dev, name);
-        if (err) {
-          ERROR("smart plugin: smart_read_nvme_intel_disk failed, %d", err);
-        }
-        break;
-
-      default:
-        DEBUG("No support vendor specific attributes");
-        break;
-      }
+      /* Open the device again next time. */
+      close(disk->fd);
+      disk->fd = -1;
+      return;
     }
 
-  } else {
+    switch (disk->vendor_id) {
+    case INTEL_VENDOR_ID:
+      err = smart_read_nvme_intel_disk(disk->fd, disk->name);
+      if (err) {
+        ERROR("smart plugin: smart_read_nvme_intel_disk failed, %d", err);
+      }
+      break;
 
-    if (sk_disk_open(dev, &d) < 0) {
-      ERROR("smart plugin: unable to open %s.", dev);
+    default:
+      DEBUG("No support vendor specific attributes");
+      break;
+    }
+  } else {
+    if ((disk->sk == NULL) && (sk_disk_open(disk->dev, &disk->sk) < 0)) {
+      ERROR("smart plugin: unable to open %s.", disk->dev);
+      disk->sk = NULL;
       return;
     }
-    smart_read_sata_disk(d, name);
-    sk_disk_free(d);
+    smart_read_sata_disk(disk->sk, disk->name);
   }
 }
 
-static int smart_read(void) {
-  struct udev *handle_udev;
+/* Takes the disks from the schedule when they are due and polls them. */
+static void *smart_worker(__attribute__((unused)) void *arg) {
+  pthread_mutex_lock(&disks_lock);
+
+  while (!workers_shutdown) {
+    uint64_t due = 0;
+    smart_disk_t *disk = c_timeheap_peek_root(schedule, &due);
+
+    if (disk == NULL) {
+      pthread_cond_wait(&disks_cond, &disks_lock);
+      continue;
+    }
+
+    if (disk->removed) {
+      c_timeheap_get_root(schedule, NULL);
+      smart_disk_free(disk);
+      continue;
+    }
+
+    cdtime_t start = cdtime();
+    if ((cdtime_t)due > start) {
+      struct timespec ts = CDTIME_T_TO_TIMESPEC((cdtime_t)due);
+      pthread_cond_timedwait(&disks_cond, &disks_lock, &ts);
+      continue;
+    }
+
+    c_timeheap_get_root(schedule, NULL);
+    pthread_mutex_unlock(&disks_lock);
+
+    smart_disk_poll(disk);
+    cdtime_t end = cdtime();
+
+    pthread_mutex_lock(&disks_lock);
+    if (disk->removed) {
+      smart_disk_free(disk);
+      continue;
+    }
+
+    if ((end - start) > conf_timeout) {
+      if (disk->backoff < SMART_MAX_BACKOFF)
+        disk->backoff *= 2;
+      WARNING("smart plugin: Polling %s took %.3f seconds. Polling it every "
+              "%d intervals.",
+              disk->dev, CDTIME_T_TO_DOUBLE(end - start), disk->backoff);
+    } else if (disk->backoff > 1) {
+      INFO("smart plugin: Polling %s every interval again.", disk->dev);
+      disk->backoff = 1;
+    }
+
+    /* Keep the disk's place in the interval; skip polls it has missed. */
+    cdtime_t next = (cdtime_t)due + disk->backoff * poll_interval;
+    while (next <= end)
+      next += poll_interval;
+
+    if (c_timeheap_insert(schedule, next, disk) != 0) {
+      ERROR("smart plugin: Scheduling %s failed.", disk->dev);
+      disk->removed = true;
+      smart_disk_t **prev = &disks;
+      while ((*prev != NULL) && (*prev != disk))
+        prev = &(*prev)->next;
+      if (*prev != NULL)
+        *prev = disk->next;
+      smart_disk_free(disk);
+    }
+  }
+
+  pthread_mutex_unlock(&disks_lock);
+  return NULL;
+}
+
+/* Adds the disk at "syspath" unless it is known already or ignored. Must be
+ * called with "disks_lock" held. */
+static int smart_disk_add(struct udev_device *dev, const char *syspath) {
+  for (smart_disk_t *disk = disks; disk != NULL; disk = disk->next) {
+    if (strcmp(disk->syspath, syspath) == 0) {
+      disk->seen = true;
+      return 0;
+    }
+  }
+
+  const char *devpath = udev_device_get_devnode(dev);
+  if (devpath == NULL)
+    return 0;
+
+  const char *serial = udev_device_get_property_value(dev, "ID_SERIAL_SHORT");
+  const char *name = smart_disk_name(devpath, serial);
+  if (name == NULL)
+    return 0;
+
+  smart_disk_t *disk = calloc(1, sizeof(*disk));
+  if (disk == NULL)
+    return ENOMEM;
+  disk->fd = -1;
+  disk->vendor_id = -1;
+  disk->backoff = 1;
+  disk->seen = true;
+  disk->nvme = (strstr(devpath, "nvme") != NULL);
+  disk->syspath = strdup(syspath);
+  disk->dev = strdup(devpath);
+  disk->name = strdup(name);
+  if ((disk->syspath == NULL) || (disk->dev == NULL) || (disk->name == NULL)) {
+    smart_disk_free(disk);
+    return ENOMEM;
+  }
+
+  /* Spread the disks over the interval, so that they are not all polled at
+   * the same time: the fractional parts of multiples of the golden ratio are
+   * evenly distributed for any number of disks. */
+  double offset = 0.6180339887 * (double)disks_added;
+  offset -= (double)(uint64_t)offset;
+  disks_added++;
+
+  cdtime_t first = cdtime() + DOUBLE_TO_CDTIME_T(
+                                  offset * CDTIME_T_TO_DOUBLE(poll_interval));
+  if (c_timeheap_insert(schedule, first, disk) != 0) {
+    smart_disk_free(disk);
+    return ENOMEM;
+  }
+
+  disk->next = disks;
+  disks = disk;
+  DEBUG("smart plugin: Added %s as \"%s\".", devpath, name);
+  return 0;
+}
+
+/* Updates "disks" from the list of disks udev knows about. */
+static int smart_refresh_disks(void) {
   struct udev_enumerate *enumerate;
   struct udev_list_entry *devices, *dev_list_entry;
-  struct udev_device *dev;
 
-  /* Use udev to get a list of disks */
-  handle_udev = udev_new();
-  if (!handle_udev) {
-    ERROR("smart plugin: unable to initialize udev.");
-    return -1;
-  }
   enumerate = udev_enumerate_new(handle_udev);
   if (enumerate == NULL) {
     ERROR("fail udev_enumerate_new");
@@ -615,28 +813,71 @@ static int smart_read(void) {
   devices = udev_enumerate_get_list_entry(enumerate);
   if (devices == NULL) {
     ERROR("udev returned an empty list deviecs");
+    udev_enumerate_unref(enumerate);
     return -1;
   }
+
+  pthread_mutex_lock(&disks_lock);
+
+  for (smart_disk_t *disk = disks; disk != NULL; disk = disk->next)
+    disk->seen = false;
+
   udev_list_entry_foreach(dev_list_entry, devices) {
-    const char *path, *devpath, *serial;
-    path = udev_list_entry_get_name(dev_list_entry);
-    dev = udev_device_new_from_syspath(handle_udev, path);
-    devpath = udev_device_get_devnode(dev);
-    serial = udev_device_get_property_value(dev, "ID_SERIAL_SHORT");
+    const char *path = udev_list_entry_get_name(dev_list_entry);
+    struct udev_device *dev = udev_device_new_from_syspath(handle_udev, path);
+    if (dev == NULL)
+      continue;
 
-    /* Query status with libatasmart */
-    smart_handle_disk(devpath, serial);
+    if (smart_disk_add(dev, path) != 0)
+      ERROR("smart plugin: Adding %s failed.", path);
     udev_device_unref(dev);
   }
 
+  /* The workers free the disks that are gone. */
+  smart_disk_t **prev = &disks;
+  while (*prev != NULL) {
+    smart_disk_t *disk = *prev;
+    if (disk->seen) {
+      prev = &disk->next;
+      continue;
+    }
+    DEBUG("smart plugin: %s is gone.", disk->dev);
+    *prev = disk->next;
+    disk->removed = true;
+  }
+
+  pthread_cond_broadcast(&disks_cond);
+  pthread_mutex_unlock(&disks_lock);
+
   udev_enumerate_unref(enumerate);
-  udev_unref(handle_udev);
+  return 0;
+}
 
+/* The disks are polled by the workers. The read callback only updates the
+ * list of disks, when udev reports that a disk was added or removed. Without
+ * a udev monitor, the disks are enumerated every interval. */
+static int smart_read(void) {
+  bool refresh = (monitor == NULL);
+
+  if (monitor != NULL) {
+    struct udev_device *dev;
+    while ((dev = udev_monitor_receive_device(monitor)) != NULL) {
+      refresh = true;
+      udev_device_unref(dev);
+    }
+  }
+
+  if (refresh)
+    return smart_refresh_disks();
   return 0;
 } /* int smart_read */
 
 static int smart_init(void) {
   int err;
+
+  if (workers != NULL)
+    return 0;
+
   if (use_serial) {
     err = create_ignorelist_by_serial(ignorelist);
     if (err != 0) {
@@ -658,11 +899,102 @@ static int smart_init(void) {
               "running \"setcap cap_sys_rawio=ep\" on the collectd binary.");
   }
 #endif
+
+  handle_udev = udev_new();
+  if (!handle_udev) {
+    ERROR("smart plugin: unable to initialize udev.");
+    return 1;
+  }
+
+  /* Created before enumerating, so that no change is missed. */
+  monitor = udev_monitor_new_from_netlink(handle_udev, "udev");
+  if ((monitor != NULL) &&
+      ((udev_monitor_filter_add_match_subsystem_devtype(monitor, "block",
+                                                        "disk") < 0) ||
+       (udev_monitor_enable_receiving(monitor) < 0))) {
+    udev_monitor_unref(monitor);
+    monitor = NULL;
+  }
+  if (monitor == NULL)
+    WARNING("smart plugin: Unable to monitor udev events. The list of disks "
+            "will be updated every interval.");
+
+  schedule = c_timeheap_create();
+  if (schedule == NULL) {
+    ERROR("smart plugin: c_timeheap_create failed.");
+    return 1;
+  }
+  poll_interval = plugin_get_interval();
+
+  err = smart_refresh_disks();
+  if (err != 0)
+    return err;
+
+  workers = calloc((size_t)conf_threads, sizeof(*workers));
+  if (workers == NULL) {
+    ERROR("smart plugin: calloc failed.");
+    return 1;
+  }
+  for (int i = 0; i < conf_threads; i++) {
+    err = plugin_thread_create(workers + workers_num, smart_worker,
+                               /* arg = */ NULL, "smart worker");
+    if (err != 0) {
+      ERROR("smart plugin: pthread_create failed: %s", STRERROR(err));
+      break;
+    }
+    workers_num++;
+  }
+  if (workers_num == 0)
+    return 1;
+
   return 0;
 } /* int smart_init */
 
+static int smart_shutdown(void) {
+  pthread_mutex_lock(&disks_lock);
+  workers_shutdown = true;
+  pthread_cond_broadcast(&disks_cond);
+  pthread_mutex_unlock(&disks_lock);
+
+  for (size_t i = 0; i < workers_num; i++)
+    pthread_join(workers[i], NULL);
+  sfree(workers);
+  workers_num = 0;
+
+  /* Disks that are still listed are freed from the list, removed ones from
+   * the schedule. */
+  if (schedule != NULL) {
+    smart_disk_t *disk;
+    while ((disk = c_timeheap_get_root(schedule, NULL)) != NULL) {
+      if (disk->removed)
+        smart_disk_free(disk);
+    }
+    c_timeheap_destroy(schedule);
+    schedule = NULL;
+  }
+  while (disks != NULL) {
+    smart_disk_t *next = disks->next;
+    smart_disk_free(disks);
+    disks = next;
+  }
+
+  if (monitor != NULL) {
+    udev_monitor_unref(monitor);
+    monitor = NULL;
+  }
+  if (handle_udev != NULL) {
+    udev_unref(handle_udev);
+    handle_udev = NULL;
+  }
+
+  ignorelist_free(ignorelist);
+  ignorelist_free(ignorelist_by_serial);
+  return 0;
+} /* int smart_shutdown */
+
 void module_register(void) {
   plugin_register_config("smart", smart_config, config_keys, config_keys_num);
   plugin_register_init("smart", smart_init);
   plugin_register_read("smart", smart_read);
+  plugin_register_shutdown("smart", smart_shutdown);
 } /* void module_register */
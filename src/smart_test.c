@@ -35,12 +35,16 @@
 int VENDOR_ID = INTEL_VID;
 const char *CORRECT_DEV_PATH = "/dev/nvme0n1";
 const char *INCORRECT_DEV_PATH = "dev/nvme0nXX";
+__u32 LAST_TIMEOUT_MS;
 
 int ioctl(int __fd, unsigned long int __request, ...) {
   va_list valist;
   va_start(valist, __request);
   struct nvme_admin_cmd *admin_cmd = va_arg(valist, struct nvme_admin_cmd *);
   va_end(valist);
+  if (__fd < 0)
+    return -1;
+  LAST_TIMEOUT_MS = admin_cmd->timeout_ms;
   void *addr = (void *)(unsigned long)admin_cmd->addr;
 
   if (admin_cmd->opcode == NVME_ADMIN_IDENTIFY) {
@@ -75,28 +79,33 @@ int open(const char *__path, int __oflag, ...) {
 
 DEF_TEST(x) {
   int ret;
+  int fd = open(CORRECT_DEV_PATH, O_RDWR);
+  int bad_fd = open(INCORRECT_DEV_PATH, O_RDWR);
 
-  ret = get_vendor_id(CORRECT_DEV_PATH, "stub");
+  ret = get_vendor_id(fd, "stub");
   EXPECT_EQ_INT(VENDOR_ID, ret);
+  EXPECT_EQ_INT(CDTIME_T_TO_MS(SMART_DEFAULT_TIMEOUT), LAST_TIMEOUT_MS);
 
   VENDOR_ID = 0x0;
-  ret = get_vendor_id(CORRECT_DEV_PATH, "stub");
+  ret = get_vendor_id(fd, "stub");
   EXPECT_EQ_INT(VENDOR_ID, ret);
   VENDOR_ID = INTEL_VID;
 
-  ret = get_vendor_id(INCORRECT_DEV_PATH, "stub");
+  ret = get_vendor_id(bad_fd, "stub");
   EXPECT_EQ_INT(-1, ret);
 
-  ret = smart_read_nvme_intel_disk(CORRECT_DEV_PATH, "stub");
+  ret = smart_read_nvme_intel_disk(fd, "stub");
   EXPECT_EQ_INT(0, ret);
 
-  ret = smart_read_nvme_intel_disk(INCORRECT_DEV_PATH, "stub");
+  ret = smart_read_nvme_intel_disk(bad_fd, "stub");
   EXPECT_EQ_INT(-1, ret);
 
-  ret = smart_read_nvme_disk(CORRECT_DEV_PATH, "stub");
+  conf_timeout = TIME_T_TO_CDTIME_T(3);
+  ret = smart_read_nvme_disk(fd, "stub");
   EXPECT_EQ_INT(0, ret);
+  EXPECT_EQ_INT(3000, LAST_TIMEOUT_MS);
 
-  ret = smart_read_nvme_disk(INCORRECT_DEV_PATH, "stub");
+  ret = smart_read_nvme_disk(bad_fd, "stub");
   EXPECT_EQ_INT(-1, ret);
 
   return 0;
@@ -75,6 +75,9 @@ struct data_definition_s {
 };
 typedef struct data_definition_s data_definition_t;
 
+struct csnmp_job_s;
+typedef struct csnmp_job_s csnmp_job_t;
+
 struct host_definition_s {
   char *name;
   char *address;
@@ -101,6 +104,17 @@ struct host_definition_s {
   data_definition_t **data_list;
   int data_list_len;
   int bulk_size;
+
+  /* Asynchronous mode, see csnmp_async_thread(). "async_busy" is guarded by
+   * csnmp_async_lock, the other fields are only used by the engine thread. */
+  int max_in_flight;
+  bool async_busy;
+  plugin_ctx_t async_ctx;
+  int async_next;
+  int async_in_flight;
+  bool async_failed;
+  csnmp_job_t *async_jobs;
+  struct host_definition_s *async_next_host;
 };
 typedef struct host_definition_s host_definition_t;
 
@@ -129,15 +143,69 @@ typedef enum {
   OID_TYPE_FILTER,
 } csnmp_oid_type_t;
 
+/* State of walking the table of one data definition on one host, one request
+ * at a time. */
+typedef struct {
+  host_definition_t *host;
+  data_definition_t *data;
+  const data_set_t *ds;
+
+  /* Holds the last OID returned by the device. We use this in the GETNEXT
+   * request to proceed. */
+  oid_t *oid_list;
+  /* Set to false when an OID has left its subtree so we don't re-request it
+   * again. */
+  csnmp_oid_type_t *oid_list_todo;
+  size_t oid_list_len;
+  /* Index into "oid_list" of each variable of the last request. */
+  size_t *var_idx;
+  size_t oid_list_todo_num;
+
+  /* `value_list_head' and `value_cells_tail' implement a linked list for each
+   * value. `instance_cells_head' and `instance_cells_tail' implement a linked
+   * list of instance names. This is used to jump gaps in the table. */
+  csnmp_cell_char_t *type_instance_cells_head;
+  csnmp_cell_char_t *type_instance_cells_tail;
+  csnmp_cell_char_t *plugin_instance_cells_head;
+  csnmp_cell_char_t *plugin_instance_cells_tail;
+  csnmp_cell_char_t *hostname_cells_head;
+  csnmp_cell_char_t *hostname_cells_tail;
+  csnmp_cell_char_t *filter_cells_head;
+  csnmp_cell_char_t *filter_cells_tail;
+  csnmp_cell_value_t **value_cells_head;
+  csnmp_cell_value_t **value_cells_tail;
+} csnmp_table_t;
+
+/* One data definition being read from a host in asynchronous mode. */
+struct csnmp_job_s {
+  host_definition_t *host;
+  data_definition_t *data;
+  /* NULL when reading single values. */
+  csnmp_table_t *table;
+  csnmp_job_t *next;
+};
+
 /*
  * Private variables
  */
 static data_definition_t *data_head;
 
+/* Asynchronous mode: the read callbacks queue their host and a single thread
+ * polls all queued hosts concurrently. */
+static bool csnmp_async;
+static pthread_mutex_t csnmp_async_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t csnmp_async_tid;
+static bool csnmp_async_running;
+static bool csnmp_async_stopping;
+static int csnmp_async_pipe[2] = {-1, -1};
+/* Hosts queued by their read callback. Guarded by csnmp_async_lock. */
+static host_definition_t *csnmp_async_queue_head;
+
 /*
  * Prototypes
  */
 static int csnmp_read_host(user_data_t *ud);
+static void csnmp_async_stop(void);
 
 /*
  * Private functions
@@ -202,6 +270,9 @@ static void csnmp_host_definition_destroy(void *arg) /* {{{ */
     DEBUG("snmp plugin: Destroying host definition for host `%s'.", hd->name);
   }
 
+  /* The engine thread may still use the host. Read callbacks are destroyed
+   * all at once on shutdown, so stopping it here is fine. */
+  csnmp_async_stop();
   csnmp_host_close_session(hd);
 
   sfree(hd->name);
@@ -772,6 +843,7 @@ static int csnmp_config_add_host(oconfig_item_t *ci) {
   hd->timeout = 0;
   hd->retries = -1;
   hd->bulk_size = 0;
+  hd->max_in_flight = 1;
 
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *option = ci->children + i;
@@ -806,6 +878,8 @@ static int csnmp_config_add_host(oconfig_item_t *ci) {
       status = cf_util_get_string(option, &hd->context);
     else if (strcasecmp("BulkSize", option->key) == 0)
       status = cf_util_get_int(option, &hd->bulk_size);
+    else if (strcasecmp("MaxInFlight", option->key) == 0)
+      status = cf_util_get_int(option, &hd->max_in_flight);
     else {
       WARNING(
           "snmp plugin: csnmp_config_add_host: Option `%s' not allowed here.",
@@ -828,6 +902,12 @@ static int csnmp_config_add_host(oconfig_item_t *ci) {
       status = -1;
       break;
     }
+    if (hd->max_in_flight < 1) {
+      WARNING("snmp plugin: `MaxInFlight' must be at least 1 for host `%s'",
+              hd->name);
+      status = -1;
+      break;
+    }
     if (hd->bulk_size > 0 && hd->version < 2) {
       WARNING("snmp plugin: Bulk transfers is only available for SNMP v2 and "
               "later, host '%s' is configured as version '%d'",
@@ -913,6 +993,8 @@ static int csnmp_config(oconfig_item_t *ci) {
       csnmp_config_add_data(child);
     else if (strcasecmp("Host", child->key) == 0)
       csnmp_config_add_host(child);
+    else if (strcasecmp("Async", child->key) == 0)
+      cf_util_get_boolean(child, &csnmp_async);
     else {
       WARNING("snmp plugin: Ignoring unknown config option `%s'.", child->key);
     }
@@ -1608,63 +1690,65 @@ static int csnmp_dispatch_table(host_definition_t *host,
   return 0;
 } /* int csnmp_dispatch_table */
 
-static int csnmp_read_table(host_definition_t *host, data_definition_t *data) {
-  struct snmp_pdu *req;
-  struct snmp_pdu *res = NULL;
-  struct variable_list *vb;
-
-  const data_set_t *ds;
-
-  size_t oid_list_len = data->values_len;
-
-  if (data->type_instance.oid.oid_len > 0)
-    oid_list_len++;
-
-  if (data->plugin_instance.oid.oid_len > 0)
-    oid_list_len++;
+static void csnmp_table_destroy(csnmp_table_t *t, bool dispatch) {
+  if (t == NULL)
+    return;
 
-  if (data->host.oid.oid_len > 0)
-    oid_list_len++;
+  if (dispatch)
+    csnmp_dispatch_table(t->host, t->data, t->type_instance_cells_head,
+                         t->plugin_instance_cells_head, t->hostname_cells_head,
+                         t->filter_cells_head, t->value_cells_head,
+                         t->data->count);
 
-  if (data->filter_oid.oid_len > 0)
-    oid_list_len++;
-
-  /* Holds the last OID returned by the device. We use this in the GETNEXT
-   * request to proceed. */
-  oid_t oid_list[oid_list_len];
-  /* Set to false when an OID has left its subtree so we don't re-request it
-   * again. */
-  csnmp_oid_type_t oid_list_todo[oid_list_len];
+  /* Free all allocated variables here */
+  while (t->type_instance_cells_head != NULL) {
+    csnmp_cell_char_t *next = t->type_instance_cells_head->next;
+    sfree(t->type_instance_cells_head);
+    t->type_instance_cells_head = next;
+  }
 
-  int status;
-  size_t i;
+  while (t->plugin_instance_cells_head != NULL) {
+    csnmp_cell_char_t *next = t->plugin_instance_cells_head->next;
+    sfree(t->plugin_instance_cells_head);
+    t->plugin_instance_cells_head = next;
+  }
 
-  /* `value_list_head' and `value_cells_tail' implement a linked list for each
-   * value. `instance_cells_head' and `instance_cells_tail' implement a linked
-   * list of instance names. This is used to jump gaps in the table. */
-  csnmp_cell_char_t *type_instance_cells_head = NULL;
-  csnmp_cell_char_t *type_instance_cells_tail = NULL;
-  csnmp_cell_char_t *plugin_instance_cells_head = NULL;
-  csnmp_cell_char_t *plugin_instance_cells_tail = NULL;
-  csnmp_cell_char_t *hostname_cells_head = NULL;
-  csnmp_cell_char_t *hostname_cells_tail = NULL;
-  csnmp_cell_char_t *filter_cells_head = NULL;
-  csnmp_cell_char_t *filter_cells_tail = NULL;
-  csnmp_cell_value_t **value_cells_head;
-  csnmp_cell_value_t **value_cells_tail;
+  while (t->hostname_cells_head != NULL) {
+    csnmp_cell_char_t *next = t->hostname_cells_head->next;
+    sfree(t->hostname_cells_head);
+    t->hostname_cells_head = next;
+  }
 
-  DEBUG("snmp plugin: csnmp_read_table (host = %s, data = %s)", host->name,
-        data->name);
+  while (t->filter_cells_head != NULL) {
+    csnmp_cell_char_t *next = t->filter_cells_head->next;
+    sfree(t->filter_cells_head);
+    t->filter_cells_head = next;
+  }
 
-  if (host->sess_handle == NULL) {
-    DEBUG("snmp plugin: csnmp_read_table: host->sess_handle == NULL");
-    return -1;
+  if (t->value_cells_head != NULL) {
+    for (size_t i = 0; i < t->data->values_len; i++) {
+      while (t->value_cells_head[i] != NULL) {
+        csnmp_cell_value_t *next = t->value_cells_head[i]->next;
+        sfree(t->value_cells_head[i]);
+        t->value_cells_head[i] = next;
+      }
+    }
   }
 
-  ds = plugin_get_ds(data->type);
+  sfree(t->value_cells_head);
+  sfree(t->value_cells_tail);
+  sfree(t->oid_list);
+  sfree(t->oid_list_todo);
+  sfree(t->var_idx);
+  sfree(t);
+} /* void csnmp_table_destroy */
+
+static csnmp_table_t *csnmp_table_create(host_definition_t *host,
+                                         data_definition_t *data) {
+  const data_set_t *ds = plugin_get_ds(data->type);
   if (!ds) {
     ERROR("snmp plugin: DataSet `%s' not defined.", data->type);
-    return -1;
+    return NULL;
   }
 
   if (data->count) {
@@ -1672,7 +1756,7 @@ static int csnmp_read_table(host_definition_t *host, data_definition_t *data) {
       ERROR("snmp plugin: DataSet `%s' requires %" PRIsz
             " values, but `Count' option only delivers one",
             data->type, ds->ds_num);
-      return -1;
+      return NULL;
     }
   } else {
     if (ds->ds_num != data->values_len) {
@@ -1680,436 +1764,450 @@ static int csnmp_read_table(host_definition_t *host, data_definition_t *data) {
             " values, but config talks "
             "about %" PRIsz,
             data->type, ds->ds_num, data->values_len);
-      return -1;
+      return NULL;
     }
   }
   assert(data->values_len > 0);
 
+  csnmp_table_t *t = calloc(1, sizeof(*t));
+  if (t == NULL) {
+    ERROR("snmp plugin: csnmp_table_create: calloc failed.");
+    return NULL;
+  }
+  t->host = host;
+  t->data = data;
+  t->ds = ds;
+
+  t->oid_list_len = data->values_len;
+
+  if (data->type_instance.oid.oid_len > 0)
+    t->oid_list_len++;
+
+  if (data->plugin_instance.oid.oid_len > 0)
+    t->oid_list_len++;
+
+  if (data->host.oid.oid_len > 0)
+    t->oid_list_len++;
+
+  if (data->filter_oid.oid_len > 0)
+    t->oid_list_len++;
+
+  /* We're going to construct n linked lists, one for each "value".
+   * value_cells_head will contain pointers to the heads of these linked lists,
+   * value_cells_tail will contain pointers to the tail of the lists. */
+  t->oid_list = calloc(t->oid_list_len, sizeof(*t->oid_list));
+  t->oid_list_todo = calloc(t->oid_list_len, sizeof(*t->oid_list_todo));
+  t->var_idx = calloc(t->oid_list_len, sizeof(*t->var_idx));
+  t->value_cells_head = calloc(data->values_len, sizeof(*t->value_cells_head));
+  t->value_cells_tail = calloc(data->values_len, sizeof(*t->value_cells_tail));
+  if ((t->oid_list == NULL) || (t->oid_list_todo == NULL) ||
+      (t->var_idx == NULL) || (t->value_cells_head == NULL) ||
+      (t->value_cells_tail == NULL)) {
+    ERROR("snmp plugin: csnmp_table_create: calloc failed.");
+    csnmp_table_destroy(t, /* dispatch = */ false);
+    return NULL;
+  }
+
+  size_t i;
   for (i = 0; i < data->values_len; i++)
-    oid_list_todo[i] = OID_TYPE_VARIABLE;
+    t->oid_list_todo[i] = OID_TYPE_VARIABLE;
 
   /* We need a copy of all the OIDs, because GETNEXT will destroy them. */
-  memcpy(oid_list, data->values, data->values_len * sizeof(oid_t));
+  memcpy(t->oid_list, data->values, data->values_len * sizeof(oid_t));
 
   if (data->type_instance.oid.oid_len > 0) {
-    memcpy(oid_list + i, &data->type_instance.oid, sizeof(oid_t));
-    oid_list_todo[i] = OID_TYPE_TYPEINSTANCE;
+    memcpy(t->oid_list + i, &data->type_instance.oid, sizeof(oid_t));
+    t->oid_list_todo[i] = OID_TYPE_TYPEINSTANCE;
     i++;
   }
 
   if (data->plugin_instance.oid.oid_len > 0) {
-    memcpy(oid_list + i, &data->plugin_instance.oid, sizeof(oid_t));
-    oid_list_todo[i] = OID_TYPE_PLUGININSTANCE;
+    memcpy(t->oid_list + i, &data->plugin_instance.oid, sizeof(oid_t));
+    t->oid_list_todo[i] = OID_TYPE_PLUGININSTANCE;
     i++;
   }
 
   if (data->host.oid.oid_len > 0) {
-    memcpy(oid_list + i, &data->host.oid, sizeof(oid_t));
-    oid_list_todo[i] = OID_TYPE_HOST;
+    memcpy(t->oid_list + i, &data->host.oid, sizeof(oid_t));
+    t->oid_list_todo[i] = OID_TYPE_HOST;
     i++;
   }
 
   if (data->filter_oid.oid_len > 0) {
-    memcpy(oid_list + i, &data->filter_oid, sizeof(oid_t));
-    oid_list_todo[i] = OID_TYPE_FILTER;
+    memcpy(t->oid_list + i, &data->filter_oid, sizeof(oid_t));
+    t->oid_list_todo[i] = OID_TYPE_FILTER;
     i++;
   }
 
-  /* We're going to construct n linked lists, one for each "value".
-   * value_cells_head will contain pointers to the heads of these linked lists,
-   * value_cells_tail will contain pointers to the tail of the lists. */
-  value_cells_head = calloc(data->values_len, sizeof(*value_cells_head));
-  value_cells_tail = calloc(data->values_len, sizeof(*value_cells_tail));
-  if ((value_cells_head == NULL) || (value_cells_tail == NULL)) {
-    ERROR("snmp plugin: csnmp_read_table: calloc failed.");
-    sfree(value_cells_head);
-    sfree(value_cells_tail);
-    return -1;
-  }
+  return t;
+} /* csnmp_table_t *csnmp_table_create */
 
-  status = 0;
-  while (status == 0) {
-    /* If SNMP v2 and later and bulk transfers enabled, use GETBULK PDU */
-    if (host->version > 1 && host->bulk_size > 0) {
-      req = snmp_pdu_create(SNMP_MSG_GETBULK);
+/* Creates the next GETNEXT or GETBULK request of the walk. Returns NULL and
+ * sets "done" when all variables have left their subtree. */
+static struct snmp_pdu *csnmp_table_request(csnmp_table_t *t, bool *done) {
+  host_definition_t *host = t->host;
+  struct snmp_pdu *req;
+
+  *done = false;
+
+  /* If SNMP v2 and later and bulk transfers enabled, use GETBULK PDU */
+  if (host->version > 1 && host->bulk_size > 0) {
+    req = snmp_pdu_create(SNMP_MSG_GETBULK);
+    if (req != NULL) {
       req->non_repeaters = 0;
       req->max_repetitions = host->bulk_size;
-    } else {
-      req = snmp_pdu_create(SNMP_MSG_GETNEXT);
     }
-    if (req == NULL) {
-      ERROR("snmp plugin: snmp_pdu_create failed.");
-      status = -1;
-      break;
-    }
-
-    size_t oid_list_todo_num = 0;
-    size_t var_idx[oid_list_len];
-    memset(var_idx, 0, sizeof(var_idx));
+  } else {
+    req = snmp_pdu_create(SNMP_MSG_GETNEXT);
+  }
+  if (req == NULL) {
+    ERROR("snmp plugin: snmp_pdu_create failed.");
+    return NULL;
+  }
 
-    for (i = 0; i < oid_list_len; i++) {
-      /* Do not rerequest already finished OIDs */
-      if (!oid_list_todo[i])
-        continue;
-      snmp_add_null_var(req, oid_list[i].oid, oid_list[i].oid_len);
-      var_idx[oid_list_todo_num] = i;
-      oid_list_todo_num++;
-    }
+  t->oid_list_todo_num = 0;
+  memset(t->var_idx, 0, t->oid_list_len * sizeof(*t->var_idx));
 
-    if (oid_list_todo_num == 0) {
-      /* The request is still empty - so we are finished */
-      DEBUG("snmp plugin: all variables have left their subtree");
-      snmp_free_pdu(req);
-      status = 0;
-      break;
-    }
+  for (size_t i = 0; i < t->oid_list_len; i++) {
+    /* Do not rerequest already finished OIDs */
+    if (!t->oid_list_todo[i])
+      continue;
+    snmp_add_null_var(req, t->oid_list[i].oid, t->oid_list[i].oid_len);
+    t->var_idx[t->oid_list_todo_num] = i;
+    t->oid_list_todo_num++;
+  }
 
-    if (req->command == SNMP_MSG_GETBULK) {
-      /* In bulk mode the host will send 'max_repetitions' values per
-         requested variable, so we need to split it per number of variable
-         to stay 'in budget' */
-      req->max_repetitions = floor(host->bulk_size / oid_list_todo_num);
-    }
+  if (t->oid_list_todo_num == 0) {
+    /* The request is still empty - so we are finished */
+    DEBUG("snmp plugin: all variables have left their subtree");
+    snmp_free_pdu(req);
+    *done = true;
+    return NULL;
+  }
 
-    res = NULL;
-    status = snmp_sess_synch_response(host->sess_handle, req, &res);
+  if (req->command == SNMP_MSG_GETBULK) {
+    /* In bulk mode the host will send 'max_repetitions' values per
+       requested variable, so we need to split it per number of variable
+       to stay 'in budget' */
+    req->max_repetitions = floor(host->bulk_size / t->oid_list_todo_num);
+  }
 
-    /* snmp_sess_synch_response always frees our req PDU */
-    req = NULL;
+  return req;
+} /* struct snmp_pdu *csnmp_table_request */
 
-    if ((status != STAT_SUCCESS) || (res == NULL)) {
-      char *errstr = NULL;
+/* Adds the variables of response "res" to the table. Does not free "res". */
+static int csnmp_table_response(csnmp_table_t *t, struct snmp_pdu *res) {
+  host_definition_t *host = t->host;
+  data_definition_t *data = t->data;
+  const data_set_t *ds = t->ds;
+  struct variable_list *vb;
+  int status = 0;
+  size_t i;
 
-      snmp_sess_error(host->sess_handle, NULL, NULL, &errstr);
+  vb = res->variables;
+  if (vb == NULL)
+    return -1;
 
-      c_complain(LOG_ERR, &host->complaint,
-                 "snmp plugin: host %s: snmp_sess_synch_response failed: %s",
-                 host->name, (errstr == NULL) ? "Unknown problem" : errstr);
+  if (res->errstat != SNMP_ERR_NOERROR) {
+    if (res->errindex != 0) {
+      /* Find the OID which caused error */
+      for (i = 1, vb = res->variables; vb != NULL && i != res->errindex;
+           vb = vb->next_variable, i++)
+        /* do nothing */;
+    }
 
-      if (res != NULL)
-        snmp_free_pdu(res);
-      res = NULL;
+    if ((res->errindex == 0) || (vb == NULL)) {
+      ERROR("snmp plugin: host %s; data %s: response error: %s (%li) ",
+            host->name, data->name, snmp_errstring(res->errstat),
+            res->errstat);
+      return -1;
+    }
 
-      sfree(errstr);
-      csnmp_host_close_session(host);
+    char oid_buffer[1024] = {0};
+    snprint_objid(oid_buffer, sizeof(oid_buffer) - 1, vb->name,
+                  vb->name_length);
+    NOTICE("snmp plugin: host %s; data %s: OID `%s` failed: %s", host->name,
+           data->name, oid_buffer, snmp_errstring(res->errstat));
 
-      status = -1;
-      break;
-    }
+    /* Get value index from todo list and skip OID found */
+    assert(res->errindex <= t->oid_list_todo_num);
+    i = t->var_idx[res->errindex - 1];
+    assert(i < t->oid_list_len);
+    t->oid_list_todo[i] = 0;
 
-    status = 0;
-    assert(res != NULL);
-    c_release(LOG_INFO, &host->complaint,
-              "snmp plugin: host %s: snmp_sess_synch_response successful.",
-              host->name);
+    return 0;
+  }
 
-    vb = res->variables;
-    if (vb == NULL) {
-      status = -1;
+  size_t j;
+  for (vb = res->variables, j = 0; (vb != NULL);
+       vb = vb->next_variable, j++) {
+    i = j;
+    /* If bulk request is active convert value index of the extra value */
+    if (host->version > 1 && host->bulk_size > 0) {
+      i %= t->oid_list_todo_num;
+    }
+    /* Calculate value index from todo list */
+    while ((i < t->oid_list_len) && !t->oid_list_todo[i]) {
+      i++;
+      j++;
+    }
+    if (i >= t->oid_list_len) {
       break;
     }
 
-    if (res->errstat != SNMP_ERR_NOERROR) {
-      if (res->errindex != 0) {
-        /* Find the OID which caused error */
-        for (i = 1, vb = res->variables; vb != NULL && i != res->errindex;
-             vb = vb->next_variable, i++)
-          /* do nothing */;
+    /* An instance is configured and the res variable we process is the
+     * instance value */
+    if (t->oid_list_todo[i] == OID_TYPE_TYPEINSTANCE) {
+      if ((vb->type == SNMP_ENDOFMIBVIEW) ||
+          (snmp_oid_ncompare(data->type_instance.oid.oid,
+                             data->type_instance.oid.oid_len, vb->name,
+                             vb->name_length,
+                             data->type_instance.oid.oid_len) != 0)) {
+        DEBUG("snmp plugin: host = %s; data = %s; TypeInstance left its "
+              "subtree.",
+              host->name, data->name);
+        t->oid_list_todo[i] = 0;
+        continue;
       }
 
-      if ((res->errindex == 0) || (vb == NULL)) {
-        ERROR("snmp plugin: host %s; data %s: response error: %s (%li) ",
-              host->name, data->name, snmp_errstring(res->errstat),
-              res->errstat);
+      /* Allocate a new `csnmp_cell_char_t', insert the instance name and
+       * add it to the list */
+      csnmp_cell_char_t *cell =
+          csnmp_get_char_cell(vb, &data->type_instance.oid, host, data);
+      if (cell == NULL) {
+        ERROR("snmp plugin: host %s: csnmp_get_char_cell() failed.",
+              host->name);
         status = -1;
         break;
       }
 
-      char oid_buffer[1024] = {0};
-      snprint_objid(oid_buffer, sizeof(oid_buffer) - 1, vb->name,
-                    vb->name_length);
-      NOTICE("snmp plugin: host %s; data %s: OID `%s` failed: %s", host->name,
-             data->name, oid_buffer, snmp_errstring(res->errstat));
-
-      /* Get value index from todo list and skip OID found */
-      assert(res->errindex <= oid_list_todo_num);
-      i = var_idx[res->errindex - 1];
-      assert(i < oid_list_len);
-      oid_list_todo[i] = 0;
-
-      snmp_free_pdu(res);
-      res = NULL;
-      continue;
-    }
+      if (csnmp_ignore_instance(cell, data)) {
+        sfree(cell);
+      } else {
+        csnmp_cell_replace_reserved_chars(cell);
 
-    size_t j;
-    for (vb = res->variables, j = 0; (vb != NULL);
-         vb = vb->next_variable, j++) {
-      i = j;
-      /* If bulk request is active convert value index of the extra value */
-      if (host->version > 1 && host->bulk_size > 0) {
-        i %= oid_list_todo_num;
+        DEBUG("snmp plugin: il->type_instance = `%s';", cell->value);
+        csnmp_cells_append(&t->type_instance_cells_head,
+                           &t->type_instance_cells_tail, cell);
       }
-      /* Calculate value index from todo list */
-      while ((i < oid_list_len) && !oid_list_todo[i]) {
-        i++;
-        j++;
+    } else if (t->oid_list_todo[i] == OID_TYPE_PLUGININSTANCE) {
+      if ((vb->type == SNMP_ENDOFMIBVIEW) ||
+          (snmp_oid_ncompare(data->plugin_instance.oid.oid,
+                             data->plugin_instance.oid.oid_len, vb->name,
+                             vb->name_length,
+                             data->plugin_instance.oid.oid_len) != 0)) {
+        DEBUG("snmp plugin: host = %s; data = %s; TypeInstance left its "
+              "subtree.",
+              host->name, data->name);
+        t->oid_list_todo[i] = 0;
+        continue;
       }
-      if (i >= oid_list_len) {
+
+      /* Allocate a new `csnmp_cell_char_t', insert the instance name and
+       * add it to the list */
+      csnmp_cell_char_t *cell =
+          csnmp_get_char_cell(vb, &data->plugin_instance.oid, host, data);
+      if (cell == NULL) {
+        ERROR("snmp plugin: host %s: csnmp_get_char_cell() failed.",
+              host->name);
+        status = -1;
         break;
       }
 
-      /* An instance is configured and the res variable we process is the
-       * instance value */
-      if (oid_list_todo[i] == OID_TYPE_TYPEINSTANCE) {
-        if ((vb->type == SNMP_ENDOFMIBVIEW) ||
-            (snmp_oid_ncompare(data->type_instance.oid.oid,
-                               data->type_instance.oid.oid_len, vb->name,
-                               vb->name_length,
-                               data->type_instance.oid.oid_len) != 0)) {
-          DEBUG("snmp plugin: host = %s; data = %s; TypeInstance left its "
-                "subtree.",
-                host->name, data->name);
-          oid_list_todo[i] = 0;
-          continue;
-        }
+      csnmp_cell_replace_reserved_chars(cell);
+
+      DEBUG("snmp plugin: il->plugin_instance = `%s';", cell->value);
+      csnmp_cells_append(&t->plugin_instance_cells_head,
+                         &t->plugin_instance_cells_tail, cell);
+    } else if (t->oid_list_todo[i] == OID_TYPE_HOST) {
+      if ((vb->type == SNMP_ENDOFMIBVIEW) ||
+          (snmp_oid_ncompare(data->host.oid.oid, data->host.oid.oid_len,
+                             vb->name, vb->name_length,
+                             data->host.oid.oid_len) != 0)) {
+        DEBUG("snmp plugin: host = %s; data = %s; Host left its subtree.",
+              host->name, data->name);
+        t->oid_list_todo[i] = 0;
+        continue;
+      }
 
-        /* Allocate a new `csnmp_cell_char_t', insert the instance name and
-         * add it to the list */
-        csnmp_cell_char_t *cell =
-            csnmp_get_char_cell(vb, &data->type_instance.oid, host, data);
-        if (cell == NULL) {
-          ERROR("snmp plugin: host %s: csnmp_get_char_cell() failed.",
-                host->name);
-          status = -1;
-          break;
-        }
+      /* Allocate a new `csnmp_cell_char_t', insert the instance name and
+       * add it to the list */
+      csnmp_cell_char_t *cell =
+          csnmp_get_char_cell(vb, &data->host.oid, host, data);
+      if (cell == NULL) {
+        ERROR("snmp plugin: host %s: csnmp_get_char_cell() failed.",
+              host->name);
+        status = -1;
+        break;
+      }
 
-        if (csnmp_ignore_instance(cell, data)) {
-          sfree(cell);
-        } else {
-          csnmp_cell_replace_reserved_chars(cell);
+      csnmp_cell_replace_reserved_chars(cell);
+
+      DEBUG("snmp plugin: il->hostname = `%s';", cell->value);
+      csnmp_cells_append(&t->hostname_cells_head, &t->hostname_cells_tail,
+                         cell);
+    } else if (t->oid_list_todo[i] == OID_TYPE_FILTER) {
+      if ((vb->type == SNMP_ENDOFMIBVIEW) ||
+          (snmp_oid_ncompare(data->filter_oid.oid, data->filter_oid.oid_len,
+                             vb->name, vb->name_length,
+                             data->filter_oid.oid_len) != 0)) {
+        DEBUG("snmp plugin: host = %s; data = %s; Host left its subtree.",
+              host->name, data->name);
+        t->oid_list_todo[i] = 0;
+        continue;
+      }
 
-          DEBUG("snmp plugin: il->type_instance = `%s';", cell->value);
-          csnmp_cells_append(&type_instance_cells_head,
-                             &type_instance_cells_tail, cell);
-        }
-      } else if (oid_list_todo[i] == OID_TYPE_PLUGININSTANCE) {
-        if ((vb->type == SNMP_ENDOFMIBVIEW) ||
-            (snmp_oid_ncompare(data->plugin_instance.oid.oid,
-                               data->plugin_instance.oid.oid_len, vb->name,
-                               vb->name_length,
-                               data->plugin_instance.oid.oid_len) != 0)) {
-          DEBUG("snmp plugin: host = %s; data = %s; TypeInstance left its "
-                "subtree.",
-                host->name, data->name);
-          oid_list_todo[i] = 0;
-          continue;
-        }
+      /* Allocate a new `csnmp_cell_char_t', insert the instance name and
+       * add it to the list */
+      csnmp_cell_char_t *cell =
+          csnmp_get_char_cell(vb, &data->filter_oid, host, data);
+      if (cell == NULL) {
+        ERROR("snmp plugin: host %s: csnmp_get_char_cell() failed.",
+              host->name);
+        status = -1;
+        break;
+      }
 
-        /* Allocate a new `csnmp_cell_char_t', insert the instance name and
-         * add it to the list */
-        csnmp_cell_char_t *cell =
-            csnmp_get_char_cell(vb, &data->plugin_instance.oid, host, data);
-        if (cell == NULL) {
-          ERROR("snmp plugin: host %s: csnmp_get_char_cell() failed.",
-                host->name);
-          status = -1;
-          break;
-        }
+      csnmp_cell_replace_reserved_chars(cell);
 
-        csnmp_cell_replace_reserved_chars(cell);
+      DEBUG("snmp plugin: il->filter = `%s';", cell->value);
+      csnmp_cells_append(&t->filter_cells_head, &t->filter_cells_tail, cell);
+    } else /* The variable we are processing is a normal value */
+    {
+      assert(t->oid_list_todo[i] == OID_TYPE_VARIABLE);
+
+      csnmp_cell_value_t *vt;
+      oid_t vb_name;
+      oid_t suffix;
+      int ret;
+
+      csnmp_oid_init(&vb_name, vb->name, vb->name_length);
+
+      /* Calculate the current suffix. This is later used to check that the
+       * suffix is increasing. This also checks if we left the subtree */
+      ret = csnmp_oid_suffix(&suffix, &vb_name, data->values + i);
+      if (ret != 0) {
+        DEBUG("snmp plugin: host = %s; data = %s; i = %" PRIsz "; "
+              "Value probably left its subtree.",
+              host->name, data->name, i);
+        t->oid_list_todo[i] = 0;
+        continue;
+      }
 
-        DEBUG("snmp plugin: il->plugin_instance = `%s';", cell->value);
-        csnmp_cells_append(&plugin_instance_cells_head,
-                           &plugin_instance_cells_tail, cell);
-      } else if (oid_list_todo[i] == OID_TYPE_HOST) {
-        if ((vb->type == SNMP_ENDOFMIBVIEW) ||
-            (snmp_oid_ncompare(data->host.oid.oid, data->host.oid.oid_len,
-                               vb->name, vb->name_length,
-                               data->host.oid.oid_len) != 0)) {
-          DEBUG("snmp plugin: host = %s; data = %s; Host left its subtree.",
-                host->name, data->name);
-          oid_list_todo[i] = 0;
-          continue;
-        }
+      /* Make sure the OIDs returned by the agent are increasing. Otherwise
+       * our table matching algorithm will get confused. */
+      if ((t->value_cells_tail[i] != NULL) &&
+          (csnmp_oid_compare(&suffix, &t->value_cells_tail[i]->suffix) <=
+           0)) {
+        DEBUG("snmp plugin: host = %s; data = %s; i = %" PRIsz "; "
+              "Suffix is not increasing.",
+              host->name, data->name, i);
+        t->oid_list_todo[i] = 0;
+        continue;
+      }
 
-        /* Allocate a new `csnmp_cell_char_t', insert the instance name and
-         * add it to the list */
-        csnmp_cell_char_t *cell =
-            csnmp_get_char_cell(vb, &data->host.oid, host, data);
-        if (cell == NULL) {
-          ERROR("snmp plugin: host %s: csnmp_get_char_cell() failed.",
-                host->name);
-          status = -1;
-          break;
-        }
+      vt = calloc(1, sizeof(*vt));
+      if (vt == NULL) {
+        ERROR("snmp plugin: calloc failed.");
+        status = -1;
+        break;
+      }
 
-        csnmp_cell_replace_reserved_chars(cell);
+      vt->value =
+          csnmp_value_list_to_value(vb, ds->ds[i].type, data->scale,
+                                    data->shift, host->name, data->name);
+      memcpy(&vt->suffix, &suffix, sizeof(vt->suffix));
+      vt->next = NULL;
 
-        DEBUG("snmp plugin: il->hostname = `%s';", cell->value);
-        csnmp_cells_append(&hostname_cells_head, &hostname_cells_tail, cell);
-      } else if (oid_list_todo[i] == OID_TYPE_FILTER) {
-        if ((vb->type == SNMP_ENDOFMIBVIEW) ||
-            (snmp_oid_ncompare(data->filter_oid.oid, data->filter_oid.oid_len,
-                               vb->name, vb->name_length,
-                               data->filter_oid.oid_len) != 0)) {
-          DEBUG("snmp plugin: host = %s; data = %s; Host left its subtree.",
-                host->name, data->name);
-          oid_list_todo[i] = 0;
-          continue;
-        }
+      if (t->value_cells_tail[i] == NULL)
+        t->value_cells_head[i] = vt;
+      else
+        t->value_cells_tail[i]->next = vt;
+      t->value_cells_tail[i] = vt;
+    }
 
-        /* Allocate a new `csnmp_cell_char_t', insert the instance name and
-         * add it to the list */
-        csnmp_cell_char_t *cell =
-            csnmp_get_char_cell(vb, &data->filter_oid, host, data);
-        if (cell == NULL) {
-          ERROR("snmp plugin: host %s: csnmp_get_char_cell() failed.",
-                host->name);
-          status = -1;
-          break;
-        }
+    /* Copy OID to oid_list[i] */
+    memcpy(t->oid_list[i].oid, vb->name, sizeof(oid) * vb->name_length);
+    t->oid_list[i].oid_len = vb->name_length;
 
-        csnmp_cell_replace_reserved_chars(cell);
+  } /* for (vb = res->variables ...) */
 
-        DEBUG("snmp plugin: il->filter = `%s';", cell->value);
-        csnmp_cells_append(&filter_cells_head, &filter_cells_tail, cell);
-      } else /* The variable we are processing is a normal value */
-      {
-        assert(oid_list_todo[i] == OID_TYPE_VARIABLE);
-
-        csnmp_cell_value_t *vt;
-        oid_t vb_name;
-        oid_t suffix;
-        int ret;
-
-        csnmp_oid_init(&vb_name, vb->name, vb->name_length);
-
-        /* Calculate the current suffix. This is later used to check that the
-         * suffix is increasing. This also checks if we left the subtree */
-        ret = csnmp_oid_suffix(&suffix, &vb_name, data->values + i);
-        if (ret != 0) {
-          DEBUG("snmp plugin: host = %s; data = %s; i = %" PRIsz "; "
-                "Value probably left its subtree.",
-                host->name, data->name, i);
-          oid_list_todo[i] = 0;
-          continue;
-        }
+  return status;
+} /* int csnmp_table_response */
 
-        /* Make sure the OIDs returned by the agent are increasing. Otherwise
-         * our table matching algorithm will get confused. */
-        if ((value_cells_tail[i] != NULL) &&
-            (csnmp_oid_compare(&suffix, &value_cells_tail[i]->suffix) <= 0)) {
-          DEBUG("snmp plugin: host = %s; data = %s; i = %" PRIsz "; "
-                "Suffix is not increasing.",
-                host->name, data->name, i);
-          oid_list_todo[i] = 0;
-          continue;
-        }
+static int csnmp_read_table(host_definition_t *host, data_definition_t *data) {
+  struct snmp_pdu *req;
+  struct snmp_pdu *res = NULL;
+  int status;
 
-        vt = calloc(1, sizeof(*vt));
-        if (vt == NULL) {
-          ERROR("snmp plugin: calloc failed.");
-          status = -1;
-          break;
-        }
+  DEBUG("snmp plugin: csnmp_read_table (host = %s, data = %s)", host->name,
+        data->name);
 
-        vt->value =
-            csnmp_value_list_to_value(vb, ds->ds[i].type, data->scale,
-                                      data->shift, host->name, data->name);
-        memcpy(&vt->suffix, &suffix, sizeof(vt->suffix));
-        vt->next = NULL;
+  if (host->sess_handle == NULL) {
+    DEBUG("snmp plugin: csnmp_read_table: host->sess_handle == NULL");
+    return -1;
+  }
 
-        if (value_cells_tail[i] == NULL)
-          value_cells_head[i] = vt;
-        else
-          value_cells_tail[i]->next = vt;
-        value_cells_tail[i] = vt;
-      }
+  csnmp_table_t *t = csnmp_table_create(host, data);
+  if (t == NULL)
+    return -1;
 
-      /* Copy OID to oid_list[i] */
-      memcpy(oid_list[i].oid, vb->name, sizeof(oid) * vb->name_length);
-      oid_list[i].oid_len = vb->name_length;
+  status = 0;
+  while (status == 0) {
+    bool done = false;
 
-    } /* for (vb = res->variables ...) */
+    req = csnmp_table_request(t, &done);
+    if (req == NULL) {
+      if (!done)
+        status = -1;
+      break;
+    }
 
-    if (res != NULL)
-      snmp_free_pdu(res);
     res = NULL;
-  } /* while (status == 0) */
+    status = snmp_sess_synch_response(host->sess_handle, req, &res);
 
-  if (res != NULL)
-    snmp_free_pdu(res);
-  res = NULL;
+    /* snmp_sess_synch_response always frees our req PDU */
+    req = NULL;
 
-  if (status == 0)
-    csnmp_dispatch_table(host, data, type_instance_cells_head,
-                         plugin_instance_cells_head, hostname_cells_head,
-                         filter_cells_head, value_cells_head, data->count);
+    if ((status != STAT_SUCCESS) || (res == NULL)) {
+      char *errstr = NULL;
 
-  /* Free all allocated variables here */
-  while (type_instance_cells_head != NULL) {
-    csnmp_cell_char_t *next = type_instance_cells_head->next;
-    sfree(type_instance_cells_head);
-    type_instance_cells_head = next;
-  }
+      snmp_sess_error(host->sess_handle, NULL, NULL, &errstr);
 
-  while (plugin_instance_cells_head != NULL) {
-    csnmp_cell_char_t *next = plugin_instance_cells_head->next;
-    sfree(plugin_instance_cells_head);
-    plugin_instance_cells_head = next;
-  }
+      c_complain(LOG_ERR, &host->complaint,
+                 "snmp plugin: host %s: snmp_sess_synch_response failed: %s",
+                 host->name, (errstr == NULL) ? "Unknown problem" : errstr);
 
-  while (hostname_cells_head != NULL) {
-    csnmp_cell_char_t *next = hostname_cells_head->next;
-    sfree(hostname_cells_head);
-    hostname_cells_head = next;
-  }
+      if (res != NULL)
+        snmp_free_pdu(res);
+      res = NULL;
 
-  while (filter_cells_head != NULL) {
-    csnmp_cell_char_t *next = filter_cells_head->next;
-    sfree(filter_cells_head);
-    filter_cells_head = next;
-  }
+      sfree(errstr);
+      csnmp_host_close_session(host);
 
-  for (i = 0; i < data->values_len; i++) {
-    while (value_cells_head[i] != NULL) {
-      csnmp_cell_value_t *next = value_cells_head[i]->next;
-      sfree(value_cells_head[i]);
-      value_cells_head[i] = next;
+      status = -1;
+      break;
     }
-  }
-
-  sfree(value_cells_head);
-  sfree(value_cells_tail);
-
-  return 0;
-} /* int csnmp_read_table */
-
-static int csnmp_read_value(host_definition_t *host, data_definition_t *data) {
-  struct snmp_pdu *req;
-  struct snmp_pdu *res = NULL;
-  struct variable_list *vb;
 
-  const data_set_t *ds;
-  value_list_t vl = VALUE_LIST_INIT;
+    c_release(LOG_INFO, &host->complaint,
+              "snmp plugin: host %s: snmp_sess_synch_response successful.",
+              host->name);
 
-  int status;
-  size_t i;
+    status = csnmp_table_response(t, res);
+    snmp_free_pdu(res);
+    res = NULL;
+  } /* while (status == 0) */
 
-  DEBUG("snmp plugin: csnmp_read_value (host = %s, data = %s)", host->name,
-        data->name);
+  csnmp_table_destroy(t, /* dispatch = */ status == 0);
 
-  if (host->sess_handle == NULL) {
-    DEBUG("snmp plugin: csnmp_read_value: host->sess_handle == NULL");
-    return -1;
-  }
+  return 0;
+} /* int csnmp_read_table */
 
-  ds = plugin_get_ds(data->type);
+static struct snmp_pdu *csnmp_value_request(data_definition_t *data) {
+  const data_set_t *ds = plugin_get_ds(data->type);
   if (!ds) {
     ERROR("snmp plugin: DataSet `%s' not defined.", data->type);
-    return -1;
+    return NULL;
   }
 
   if (ds->ds_num != data->values_len) {
@@ -2117,9 +2215,33 @@ static int csnmp_read_value(host_definition_t *host, data_definition_t *data) {
           " values, but config talks "
           "about %" PRIsz,
           data->type, ds->ds_num, data->values_len);
-    return -1;
+    return NULL;
   }
 
+  struct snmp_pdu *req = snmp_pdu_create(SNMP_MSG_GET);
+  if (req == NULL) {
+    ERROR("snmp plugin: snmp_pdu_create failed.");
+    return NULL;
+  }
+
+  for (size_t i = 0; i < data->values_len; i++)
+    snmp_add_null_var(req, data->values[i].oid, data->values[i].oid_len);
+
+  return req;
+} /* struct snmp_pdu *csnmp_value_request */
+
+/* Dispatches the values of response "res". Does not free "res". */
+static int csnmp_value_response(host_definition_t *host,
+                                data_definition_t *data,
+                                struct snmp_pdu *res) {
+  value_list_t vl = VALUE_LIST_INIT;
+  struct variable_list *vb;
+  size_t i;
+
+  const data_set_t *ds = plugin_get_ds(data->type);
+  if ((ds == NULL) || (ds->ds_num != data->values_len))
+    return -1;
+
   vl.values_len = ds->ds_num;
   vl.values = malloc(sizeof(*vl.values) * vl.values_len);
   if (vl.values == NULL)
@@ -2141,15 +2263,44 @@ static int csnmp_read_value(host_definition_t *host, data_definition_t *data) {
     sstrncpy(vl.plugin_instance, data->plugin_instance.value,
              sizeof(vl.plugin_instance));
 
-  req = snmp_pdu_create(SNMP_MSG_GET);
-  if (req == NULL) {
-    ERROR("snmp plugin: snmp_pdu_create failed.");
-    sfree(vl.values);
+  for (vb = res->variables; vb != NULL; vb = vb->next_variable) {
+#if COLLECT_DEBUG
+    char buffer[1024];
+    snprint_variable(buffer, sizeof(buffer), vb->name, vb->name_length, vb);
+    DEBUG("snmp plugin: Got this variable: %s", buffer);
+#endif /* COLLECT_DEBUG */
+
+    for (i = 0; i < data->values_len; i++)
+      if (snmp_oid_compare(data->values[i].oid, data->values[i].oid_len,
+                           vb->name, vb->name_length) == 0)
+        vl.values[i] =
+            csnmp_value_list_to_value(vb, ds->ds[i].type, data->scale,
+                                      data->shift, host->name, data->name);
+  } /* for (res->variables) */
+
+  DEBUG("snmp plugin: -> plugin_dispatch_values (&vl);");
+  plugin_dispatch_values(&vl);
+  sfree(vl.values);
+
+  return 0;
+} /* int csnmp_value_response */
+
+static int csnmp_read_value(host_definition_t *host, data_definition_t *data) {
+  struct snmp_pdu *req;
+  struct snmp_pdu *res = NULL;
+  int status;
+
+  DEBUG("snmp plugin: csnmp_read_value (host = %s, data = %s)", host->name,
+        data->name);
+
+  if (host->sess_handle == NULL) {
+    DEBUG("snmp plugin: csnmp_read_value: host->sess_handle == NULL");
     return -1;
   }
 
-  for (i = 0; i < data->values_len; i++)
-    snmp_add_null_var(req, data->values[i].oid, data->values[i].oid_len);
+  req = csnmp_value_request(data);
+  if (req == NULL)
+    return -1;
 
   status = snmp_sess_synch_response(host->sess_handle, req, &res);
 
@@ -2164,35 +2315,360 @@ static int csnmp_read_value(host_definition_t *host, data_definition_t *data) {
       snmp_free_pdu(res);
 
     sfree(errstr);
-    sfree(vl.values);
     csnmp_host_close_session(host);
 
     return -1;
   }
 
-  for (vb = res->variables; vb != NULL; vb = vb->next_variable) {
-#if COLLECT_DEBUG
-    char buffer[1024];
-    snprint_variable(buffer, sizeof(buffer), vb->name, vb->name_length, vb);
-    DEBUG("snmp plugin: Got this variable: %s", buffer);
-#endif /* COLLECT_DEBUG */
+  status = csnmp_value_response(host, data, res);
+  snmp_free_pdu(res);
 
-    for (i = 0; i < data->values_len; i++)
-      if (snmp_oid_compare(data->values[i].oid, data->values[i].oid_len,
-                           vb->name, vb->name_length) == 0)
-        vl.values[i] =
-            csnmp_value_list_to_value(vb, ds->ds[i].type, data->scale,
-                                      data->shift, host->name, data->name);
-  } /* for (res->variables) */
+  return status;
+} /* int csnmp_read_value */
 
-  snmp_free_pdu(res);
+/* Asynchronous mode {{{
+ *
+ * Read callbacks of all hosts only queue their host. A single thread takes
+ * queued hosts, starts reading up to "MaxInFlight" data definitions of each
+ * host at once and waits for the responses of all hosts with select(2). Table
+ * walks send their next request from the response callback, so requests for
+ * many hosts and many tables are in flight at the same time. */
+static void csnmp_async_job_finish(csnmp_job_t *job, int status) {
+  host_definition_t *host = job->host;
+
+  for (csnmp_job_t **j = &host->async_jobs; *j != NULL; j = &(*j)->next) {
+    if (*j == job) {
+      *j = job->next;
+      break;
+    }
+  }
+  host->async_in_flight--;
 
-  DEBUG("snmp plugin: -> plugin_dispatch_values (&vl);");
-  plugin_dispatch_values(&vl);
-  sfree(vl.values);
+  csnmp_table_destroy(job->table, /* dispatch = */ status == 0);
+  sfree(job);
+} /* void csnmp_async_job_finish */
+
+static int csnmp_async_callback(int operation, netsnmp_session *session,
+                                int reqid, netsnmp_pdu *pdu, void *magic);
+
+static int csnmp_async_send(csnmp_job_t *job, struct snmp_pdu *req) {
+  host_definition_t *host = job->host;
+
+  if (snmp_sess_async_send(host->sess_handle, req, csnmp_async_callback,
+                           job) == 0) {
+    char *errstr = NULL;
+
+    snmp_sess_error(host->sess_handle, NULL, NULL, &errstr);
+    c_complain(LOG_ERR, &host->complaint,
+               "snmp plugin: host %s: snmp_sess_async_send failed: %s",
+               host->name, (errstr == NULL) ? "Unknown problem" : errstr);
+    sfree(errstr);
+
+    /* The PDU is only freed by net-snmp when sending succeeded. */
+    snmp_free_pdu(req);
+    host->async_failed = true;
+    return -1;
+  }
 
   return 0;
-} /* int csnmp_read_value */
+} /* int csnmp_async_send */
+
+static int csnmp_async_callback(int operation,
+                                netsnmp_session __attribute__((unused)) *
+                                    session,
+                                int __attribute__((unused)) reqid,
+                                netsnmp_pdu *pdu, void *magic) {
+  csnmp_job_t *job = magic;
+  host_definition_t *host = job->host;
+
+  /* Outstanding requests are dropped when the sessions are closed on
+   * shutdown. The jobs are freed afterwards. */
+  if (csnmp_async_stopping)
+    return 1;
+
+  if (operation == NETSNMP_CALLBACK_OP_TIMED_OUT
+#ifdef NETSNMP_CALLBACK_OP_SEND_FAILED
+      || operation == NETSNMP_CALLBACK_OP_SEND_FAILED
+#endif
+  ) {
+    c_complain(LOG_ERR, &host->complaint,
+               "snmp plugin: host %s: data %s: request failed or timed out.",
+               host->name, job->data->name);
+    host->async_failed = true;
+    csnmp_async_job_finish(job, -1);
+    return 1;
+  }
+
+  if (operation != NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE)
+    return 1;
+
+  c_release(LOG_INFO, &host->complaint,
+            "snmp plugin: host %s: asynchronous request successful.",
+            host->name);
+
+  if (job->table == NULL) {
+    csnmp_async_job_finish(job, csnmp_value_response(host, job->data, pdu));
+    return 1;
+  }
+
+  if (csnmp_table_response(job->table, pdu) != 0) {
+    csnmp_async_job_finish(job, -1);
+    return 1;
+  }
+
+  bool done = false;
+  struct snmp_pdu *req = csnmp_table_request(job->table, &done);
+  if (req == NULL) {
+    csnmp_async_job_finish(job, done ? 0 : -1);
+    return 1;
+  }
+
+  if (csnmp_async_send(job, req) != 0)
+    csnmp_async_job_finish(job, -1);
+
+  return 1;
+} /* int csnmp_async_callback */
+
+static void csnmp_async_job_start(host_definition_t *host,
+                                  data_definition_t *data) {
+  csnmp_job_t *job = calloc(1, sizeof(*job));
+  if (job == NULL) {
+    ERROR("snmp plugin: csnmp_async_job_start: calloc failed.");
+    return;
+  }
+  job->host = host;
+  job->data = data;
+  job->next = host->async_jobs;
+  host->async_jobs = job;
+  host->async_in_flight++;
+
+  struct snmp_pdu *req;
+  if (data->is_table) {
+    job->table = csnmp_table_create(host, data);
+    if (job->table == NULL) {
+      csnmp_async_job_finish(job, -1);
+      return;
+    }
+
+    bool done = false;
+    req = csnmp_table_request(job->table, &done);
+    if (req == NULL) {
+      csnmp_async_job_finish(job, done ? 0 : -1);
+      return;
+    }
+  } else {
+    req = csnmp_value_request(data);
+    if (req == NULL) {
+      csnmp_async_job_finish(job, -1);
+      return;
+    }
+  }
+
+  if (csnmp_async_send(job, req) != 0)
+    csnmp_async_job_finish(job, -1);
+} /* void csnmp_async_job_start */
+
+/* Starts reading further data definitions of "host" while it has less than
+ * "MaxInFlight" requests outstanding. Returns true once the host is done. */
+static bool csnmp_async_host_step(host_definition_t *host) {
+  if (!host->async_failed && (host->sess_handle == NULL))
+    csnmp_host_open_session(host);
+  if (host->sess_handle == NULL)
+    host->async_failed = true;
+
+  /* Don't start more requests to a host that is not answering. */
+  if (host->async_failed)
+    host->async_next = host->data_list_len;
+
+  while ((host->async_in_flight < host->max_in_flight) &&
+         (host->async_next < host->data_list_len))
+    csnmp_async_job_start(host, host->data_list[host->async_next++]);
+
+  if ((host->async_in_flight > 0) ||
+      (host->async_next < host->data_list_len))
+    return false;
+
+  /* The session is reopened on the next poll. */
+  if (host->async_failed)
+    csnmp_host_close_session(host);
+  return true;
+} /* bool csnmp_async_host_step */
+
+static void *csnmp_async_thread(void __attribute__((unused)) * arg) {
+  host_definition_t *active = NULL;
+  netsnmp_large_fd_set fdset;
+
+  netsnmp_large_fd_set_init(&fdset, FD_SETSIZE);
+
+  while (42) {
+    pthread_mutex_lock(&csnmp_async_lock);
+    if (csnmp_async_stopping) {
+      pthread_mutex_unlock(&csnmp_async_lock);
+      break;
+    }
+    while (csnmp_async_queue_head != NULL) {
+      host_definition_t *host = csnmp_async_queue_head;
+      csnmp_async_queue_head = host->async_next_host;
+
+      host->async_next = 0;
+      host->async_failed = false;
+      host->async_next_host = active;
+      active = host;
+    }
+    pthread_mutex_unlock(&csnmp_async_lock);
+
+    int numfds = csnmp_async_pipe[0] + 1;
+    struct timeval timeout = {.tv_sec = 1};
+
+    netsnmp_large_fd_set_resize(&fdset, FD_SETSIZE);
+    NETSNMP_LARGE_FD_ZERO(&fdset);
+    netsnmp_large_fd_setfd(csnmp_async_pipe[0], &fdset);
+
+    for (host_definition_t **h = &active; *h != NULL;) {
+      host_definition_t *host = *h;
+      plugin_ctx_t old_ctx = plugin_set_ctx(host->async_ctx);
+      bool done = csnmp_async_host_step(host);
+      plugin_set_ctx(old_ctx);
+
+      if (done) {
+        *h = host->async_next_host;
+        host->async_next_host = NULL;
+
+        pthread_mutex_lock(&csnmp_async_lock);
+        host->async_busy = false;
+        pthread_mutex_unlock(&csnmp_async_lock);
+        continue;
+      }
+
+      int block = 1;
+      struct timeval tv = {0};
+      snmp_sess_select_info2(host->sess_handle, &numfds, &fdset, &tv, &block);
+      if (!block && timercmp(&tv, &timeout, <))
+        timeout = tv;
+
+      h = &host->async_next_host;
+    }
+
+    int status = netsnmp_large_fd_set_select(numfds, &fdset, NULL, NULL,
+                                             &timeout);
+    if ((status < 0) && (errno != EINTR)) {
+      ERROR("snmp plugin: select failed: %s", STRERRNO);
+      continue;
+    }
+
+    if ((status > 0) && netsnmp_large_fd_is_set(csnmp_async_pipe[0], &fdset)) {
+      char buffer[64];
+      while (read(csnmp_async_pipe[0], buffer, sizeof(buffer)) > 0)
+        /* drain */;
+    }
+
+    for (host_definition_t *host = active; host != NULL;
+         host = host->async_next_host) {
+      plugin_ctx_t old_ctx = plugin_set_ctx(host->async_ctx);
+      if ((status > 0) && (host->sess_handle != NULL))
+        snmp_sess_read2(host->sess_handle, &fdset);
+      if (host->sess_handle != NULL)
+        snmp_sess_timeout(host->sess_handle);
+      plugin_set_ctx(old_ctx);
+    }
+  } /* while (42) */
+
+  /* Drop all outstanding requests, then the jobs they belonged to. */
+  while (active != NULL) {
+    host_definition_t *host = active;
+    active = host->async_next_host;
+    host->async_next_host = NULL;
+
+    csnmp_host_close_session(host);
+    while (host->async_jobs != NULL)
+      csnmp_async_job_finish(host->async_jobs, -1);
+  }
+
+  netsnmp_large_fd_set_cleanup(&fdset);
+  return NULL;
+} /* void *csnmp_async_thread */
+
+static void csnmp_async_wakeup(void) {
+  if (csnmp_async_pipe[1] >= 0)
+    (void)write(csnmp_async_pipe[1], "", 1);
+} /* void csnmp_async_wakeup */
+
+/* Must be called with csnmp_async_lock held. */
+static int csnmp_async_start(void) {
+  if (pipe(csnmp_async_pipe) != 0) {
+    ERROR("snmp plugin: pipe failed: %s", STRERRNO);
+    return -1;
+  }
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(csnmp_async_pipe); i++) {
+    fcntl(csnmp_async_pipe[i], F_SETFL,
+          fcntl(csnmp_async_pipe[i], F_GETFL) | O_NONBLOCK);
+    fcntl(csnmp_async_pipe[i], F_SETFD, FD_CLOEXEC);
+  }
+
+  int status = plugin_thread_create(&csnmp_async_tid, csnmp_async_thread,
+                                    NULL, "snmp async");
+  if (status != 0) {
+    ERROR("snmp plugin: plugin_thread_create failed: %s", STRERROR(status));
+    close(csnmp_async_pipe[0]);
+    close(csnmp_async_pipe[1]);
+    csnmp_async_pipe[0] = csnmp_async_pipe[1] = -1;
+    return -1;
+  }
+
+  csnmp_async_running = true;
+  return 0;
+} /* int csnmp_async_start */
+
+static void csnmp_async_stop(void) {
+  pthread_mutex_lock(&csnmp_async_lock);
+  if (!csnmp_async_running) {
+    pthread_mutex_unlock(&csnmp_async_lock);
+    return;
+  }
+  csnmp_async_stopping = true;
+  csnmp_async_running = false;
+  pthread_mutex_unlock(&csnmp_async_lock);
+
+  csnmp_async_wakeup();
+  pthread_join(csnmp_async_tid, NULL);
+
+  close(csnmp_async_pipe[0]);
+  close(csnmp_async_pipe[1]);
+  csnmp_async_pipe[0] = csnmp_async_pipe[1] = -1;
+} /* void csnmp_async_stop */
+
+static int csnmp_async_queue(host_definition_t *host) {
+  pthread_mutex_lock(&csnmp_async_lock);
+
+  if (csnmp_async_stopping) {
+    pthread_mutex_unlock(&csnmp_async_lock);
+    return -1;
+  }
+
+  if (!csnmp_async_running && (csnmp_async_start() != 0)) {
+    pthread_mutex_unlock(&csnmp_async_lock);
+    return -1;
+  }
+
+  if (host->async_busy) {
+    pthread_mutex_unlock(&csnmp_async_lock);
+    WARNING("snmp plugin: host %s: The previous poll has not finished yet. "
+            "Skipping this interval.",
+            host->name);
+    return 0;
+  }
+
+  host->async_busy = true;
+  host->async_ctx = plugin_get_ctx();
+  host->async_next_host = csnmp_async_queue_head;
+  csnmp_async_queue_head = host;
+
+  pthread_mutex_unlock(&csnmp_async_lock);
+
+  csnmp_async_wakeup();
+  return 0;
+} /* int csnmp_async_queue */
+/* }}} Asynchronous mode */
 
 static int csnmp_read_host(user_data_t *ud) {
   host_definition_t *host;
@@ -2202,6 +2678,9 @@ static int csnmp_read_host(user_data_t *ud) {
 
   host = ud->data;
 
+  if (csnmp_async)
+    return csnmp_async_queue(host);
+
   if (host->sess_handle == NULL)
     csnmp_host_open_session(host);
 
@@ -2239,6 +2718,8 @@ static int csnmp_shutdown(void) {
 
   /* When we get here, the read threads have been stopped and all the
    * `host_definition_t' will be freed. */
+  csnmp_async_stop();
+
   DEBUG("snmp plugin: Destroying all data definitions.");
 
   data_this = data_head;
@@ -31,7 +31,6 @@
 
 #include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
-#include "utils_cache.h"
 #include "utils_llist.h"
 #include <regex.h>
 
@@ -105,6 +104,8 @@ struct table_definition_s {
 };
 typedef struct table_definition_s table_definition_t;
 
+struct snmp_agent_value_s;
+
 struct data_definition_s {
   char *name;
   char *plugin;
@@ -118,9 +119,36 @@ struct data_definition_s {
   size_t oids_len;
   double scale;
   double shift;
+  c_avl_tree_t *rows; /* Values of table columns by index OID */
+  struct snmp_agent_value_s *value; /* Values of scalars */
 };
 typedef struct data_definition_s data_definition_t;
 
+/* Last values of an identifier reported by a table column and/or a scalar.
+ * They are updated from cache events, so that requests are answered without
+ * querying the cache. */
+struct snmp_agent_value_s {
+  char *name; /* Identifier, key of g_agent->values */
+  data_definition_t *dd; /* Table column, or NULL */
+  table_definition_t *td;
+  oid_t index_oid;
+  bool served; /* Requests for index_oid in dd are answered with this */
+  data_definition_t *scalar; /* Scalar, or NULL */
+  size_t values_num;
+  value_t values[];
+};
+typedef struct snmp_agent_value_s snmp_agent_value_t;
+
+/* Column OID of a table. g_agent->columns is sorted by OID, so that the
+ * column of a requested OID is found with a binary search. */
+struct table_column_s {
+  const oid_t *oid;
+  data_definition_t *dd;
+  table_definition_t *td;
+  size_t oid_index; /* Index of oid in dd->oids */
+};
+typedef struct table_column_s table_column_t;
+
 struct snmp_agent_ctx_s {
   pthread_t thread;
   pthread_mutex_t lock;
@@ -130,6 +158,9 @@ struct snmp_agent_ctx_s {
   llist_t *tables;
   llist_t *scalars;
   c_avl_tree_t *registered_oids; /* AVL tree containing all registered OIDs */
+  c_avl_tree_t *values;          /* snmp_agent_value_t by identifier */
+  table_column_t *columns;
+  size_t columns_num;
 };
 typedef struct snmp_agent_ctx_s snmp_agent_ctx_t;
 
@@ -153,6 +184,7 @@ static int snmp_agent_unregister_oid_index(oid_t *oid, int index);
 static int snmp_agent_update_instance_oids(c_avl_tree_t *tree, oid_t *index_oid,
                                            int value);
 static int num_compare(const int *a, const int *b);
+static int oid_compare(const oid_t *a, const oid_t *b);
 
 static u_char snmp_agent_get_asn_type(oid *oid, size_t oid_len) {
   struct tree *node = get_tree(oid, oid_len, g_agent->tp);
@@ -766,42 +798,6 @@ static void snmp_agent_table_data_remove(data_definition_t *dd,
   }
 }
 
-static int snmp_agent_clear_missing(const value_list_t *vl,
-                                    __attribute__((unused)) user_data_t *ud) {
-  if (vl == NULL)
-    return -EINVAL;
-
-  for (llentry_t *te = llist_head(g_agent->tables); te != NULL; te = te->next) {
-    table_definition_t *td = te->value;
-
-    for (llentry_t *de = llist_head(td->columns); de != NULL; de = de->next) {
-      data_definition_t *dd = de->value;
-
-      if (!dd->is_index_key) {
-        if (CHECK_DD_TYPE(dd, vl->plugin, vl->plugin_instance, vl->type,
-                          vl->type_instance)) {
-          oid_t *index_oid = calloc(1, sizeof(*index_oid));
-
-          if (index_oid == NULL) {
-            ERROR(PLUGIN_NAME ": Could not allocate memory for index_oid");
-            return -ENOMEM;
-          }
-
-          int ret = snmp_agent_generate_index(td, vl, index_oid);
-
-          if (ret == 0)
-            snmp_agent_table_data_remove(dd, td, index_oid);
-          sfree(index_oid);
-
-          return ret;
-        }
-      }
-    }
-  }
-
-  return 0;
-}
-
 static void snmp_agent_free_data(data_definition_t **dd) {
 
   if (dd == NULL || *dd == NULL)
@@ -813,6 +809,10 @@ static void snmp_agent_free_data(data_definition_t **dd) {
       unregister_mib((*dd)->oids[i].oid, (*dd)->oids[i].oid_len);
   }
 
+  /* The values are freed with g_agent->values. */
+  if ((*dd)->rows != NULL)
+    c_avl_destroy((*dd)->rows);
+
   sfree((*dd)->name);
   sfree((*dd)->plugin);
   sfree((*dd)->plugin_instance);
@@ -1087,42 +1087,37 @@ static int snmp_agent_form_reply(struct netsnmp_request_info_s *requests,
     return SNMP_ERR_NOERROR;
   }
 
-  char name[DATA_MAX_NAME_LEN];
+  snmp_agent_value_t *v = NULL;
+  if (index_oid == NULL)
+    v = dd->value;
+  else if (dd->rows != NULL)
+    c_avl_get(dd->rows, index_oid, (void **)&v);
 
-  ret = snmp_agent_format_name(name, sizeof(name), dd, index_oid);
-  if (ret != 0)
-    return ret;
+  if (v == NULL) {
+    ERROR(PLUGIN_NAME ": No value available for '%s'", dd->name);
+    return SNMP_NOSUCHINSTANCE;
+  }
 
-  DEBUG(PLUGIN_NAME ": Identifier '%s'", name);
+  DEBUG(PLUGIN_NAME ": Identifier '%s'", v->name);
 
-  value_t *values;
-  size_t values_num;
   const data_set_t *ds = plugin_get_ds(dd->type);
   if (ds == NULL) {
     ERROR(PLUGIN_NAME ": Data set not found for '%s' type", dd->type);
     return SNMP_NOSUCHINSTANCE;
   }
 
-  ret = uc_get_value_by_name(name, &values, &values_num);
-
-  if (ret != 0) {
-    ERROR(PLUGIN_NAME ": Failed to get value for '%s'", name);
-    return SNMP_NOSUCHINSTANCE;
-  }
-
-  assert(ds->ds_num == values_num);
-  assert(oid_index < (int)values_num);
+  assert(ds->ds_num == v->values_num);
+  assert(oid_index < (int)v->values_num);
 
   char data[DATA_MAX_NAME_LEN];
   size_t data_len = sizeof(data);
   ret = snmp_agent_set_vardata(
       data, &data_len, dd->oids[oid_index].type, dd->scale, dd->shift,
-      &values[oid_index], sizeof(values[oid_index]), ds->ds[oid_index].type);
-
-  sfree(values);
+      &v->values[oid_index], sizeof(v->values[oid_index]),
+      ds->ds[oid_index].type);
 
   if (ret != 0) {
-    ERROR(PLUGIN_NAME ": Failed to convert '%s' value to snmp data", name);
+    ERROR(PLUGIN_NAME ": Failed to convert '%s' value to snmp data", v->name);
     return SNMP_NOSUCHINSTANCE;
   }
 
@@ -1133,6 +1128,23 @@ static int snmp_agent_form_reply(struct netsnmp_request_info_s *requests,
   return SNMP_ERR_NOERROR;
 }
 
+static int snmp_agent_column_compare(const void *a, const void *b) {
+  const table_column_t *ca = a;
+  const table_column_t *cb = b;
+
+  return snmp_oid_compare(ca->oid->oid, ca->oid->oid_len, cb->oid->oid,
+                          cb->oid->oid_len);
+}
+
+/* Finds the column which the requested OID "key" starts with. */
+static int snmp_agent_column_search(const void *key, const void *member) {
+  const oid_t *o = key;
+  const table_column_t *c = member;
+
+  return snmp_oid_ncompare(o->oid, o->oid_len, c->oid->oid, c->oid->oid_len,
+                           c->oid->oid_len);
+}
+
 static int
 snmp_agent_table_oid_handler(struct netsnmp_mib_handler_s *handler,
                              struct netsnmp_handler_registration_s *reginfo,
@@ -1158,56 +1170,49 @@ snmp_agent_table_oid_handler(struct netsnmp_mib_handler_s *handler,
 #endif
   oid_t index_oid; /* Index part of requested OID */
 
-  for (llentry_t *te = llist_head(g_agent->tables); te != NULL; te = te->next) {
-    table_definition_t *td = te->value;
+  table_column_t *column =
+      bsearch(&oid, g_agent->columns, g_agent->columns_num,
+              sizeof(*g_agent->columns), snmp_agent_column_search);
+  if ((column == NULL) || (oid.oid_len <= column->oid->oid_len)) {
+    pthread_mutex_unlock(&g_agent->lock);
+    return SNMP_NOSUCHINSTANCE;
+  }
 
-    for (llentry_t *de = llist_head(td->columns); de != NULL; de = de->next) {
-      data_definition_t *dd = de->value;
+  table_definition_t *td = column->td;
 
-      for (size_t i = 0; i < dd->oids_len; i++) {
-        int ret = snmp_oid_ncompare(oid.oid, oid.oid_len, dd->oids[i].oid,
-                                    dd->oids[i].oid_len,
-                                    SNMP_MIN(oid.oid_len, dd->oids[i].oid_len));
-        if (ret != 0)
-          continue;
-
-        /* Calculating OID length for index part */
-        index_oid.oid_len = oid.oid_len - dd->oids[i].oid_len;
-        /* Fetching index part of the OID */
-        memcpy(index_oid.oid, &oid.oid[dd->oids[i].oid_len],
-               index_oid.oid_len * sizeof(*oid.oid));
-
-        char index_str[DATA_MAX_NAME_LEN];
-        snmp_agent_oid_to_string(index_str, sizeof(index_str), &index_oid);
-
-        if (!td->index_oid.oid_len) {
-          ret = c_avl_get(td->instance_index, &index_oid, NULL);
-        } else {
-          oid_t *temp_oid;
-
-          assert(index_oid.oid_len == 1);
-          ret = c_avl_get(td->index_instance, (int *)&index_oid.oid[0],
-                          (void **)&temp_oid);
-          memcpy(&index_oid, temp_oid, sizeof(index_oid));
-        }
+  /* Calculating OID length for index part */
+  index_oid.oid_len = oid.oid_len - column->oid->oid_len;
+  /* Fetching index part of the OID */
+  memcpy(index_oid.oid, &oid.oid[column->oid->oid_len],
+         index_oid.oid_len * sizeof(*oid.oid));
 
-        if (ret != 0) {
-          INFO(PLUGIN_NAME ": Non-existing index (%s) requested", index_str);
-          pthread_mutex_unlock(&g_agent->lock);
-          return SNMP_NOSUCHINSTANCE;
-        }
+  char index_str[DATA_MAX_NAME_LEN];
+  snmp_agent_oid_to_string(index_str, sizeof(index_str), &index_oid);
 
-        ret = snmp_agent_form_reply(requests, dd, &index_oid, i);
-        pthread_mutex_unlock(&g_agent->lock);
+  int ret;
+  if (!td->index_oid.oid_len) {
+    ret = c_avl_get(td->instance_index, &index_oid, NULL);
+  } else {
+    oid_t *temp_oid;
 
-        return ret;
-      }
-    }
+    assert(index_oid.oid_len == 1);
+    ret = c_avl_get(td->index_instance, (int *)&index_oid.oid[0],
+                    (void **)&temp_oid);
+    if (ret == 0)
+      memcpy(&index_oid, temp_oid, sizeof(index_oid));
   }
 
+  if (ret != 0) {
+    INFO(PLUGIN_NAME ": Non-existing index (%s) requested", index_str);
+    pthread_mutex_unlock(&g_agent->lock);
+    return SNMP_NOSUCHINSTANCE;
+  }
+
+  ret = snmp_agent_form_reply(requests, column->dd, &index_oid,
+                              (int)column->oid_index);
   pthread_mutex_unlock(&g_agent->lock);
 
-  return SNMP_NOSUCHINSTANCE;
+  return ret;
 }
 
 static int snmp_agent_table_index_oid_handler(
@@ -1382,9 +1387,31 @@ static int snmp_agent_register_table_oids(void) {
         dd->oids[i].type =
             snmp_agent_get_asn_type(dd->oids[i].oid, dd->oids[i].oid_len);
       }
+
+      if (!dd->is_index_key) {
+        dd->rows =
+            c_avl_create((int (*)(const void *, const void *))oid_compare);
+        if (dd->rows == NULL)
+          return -ENOMEM;
+      }
+
+      table_column_t *tmp =
+          realloc(g_agent->columns, (g_agent->columns_num + dd->oids_len) *
+                                        sizeof(*g_agent->columns));
+      if (tmp == NULL)
+        return -ENOMEM;
+      g_agent->columns = tmp;
+
+      for (size_t i = 0; i < dd->oids_len; i++)
+        g_agent->columns[g_agent->columns_num++] = (table_column_t){
+            .oid = &dd->oids[i], .dd = dd, .td = td, .oid_index = i};
     }
   }
 
+  if (g_agent->columns_num > 0)
+    qsort(g_agent->columns, g_agent->columns_num, sizeof(*g_agent->columns),
+          snmp_agent_column_compare);
+
   return 0;
 }
 
@@ -2029,55 +2056,170 @@ error:
   return ret;
 }
 
-static int snmp_agent_write(value_list_t const *vl) {
-  if (vl == NULL)
-    return -EINVAL;
-
-  for (llentry_t *te = llist_head(g_agent->tables); te != NULL; te = te->next) {
-    table_definition_t *td = te->value;
+/* Adds the identifier of a new cache entry to the tables and scalars
+ * reporting it. */
+static int snmp_agent_value_new(cache_event_t *event) {
+  value_list_t const *vl = event->value_list;
+  table_definition_t *td = NULL;
+  data_definition_t *column = NULL;
+  data_definition_t *scalar = NULL;
+  char name[DATA_MAX_NAME_LEN];
 
-    for (llentry_t *de = llist_head(td->columns); de != NULL; de = de->next) {
+  for (llentry_t *te = llist_head(g_agent->tables);
+       (te != NULL) && (column == NULL); te = te->next) {
+    for (llentry_t *de = llist_head(((table_definition_t *)te->value)->columns);
+         de != NULL; de = de->next) {
       data_definition_t *dd = de->value;
 
-      if (!dd->is_index_key) {
-        if (CHECK_DD_TYPE(dd, vl->plugin, vl->plugin_instance, vl->type,
-                          vl->type_instance)) {
-          oid_t *index_oid = calloc(1, sizeof(*index_oid));
-          bool free_index_oid = true;
+      if (!dd->is_index_key &&
+          CHECK_DD_TYPE(dd, vl->plugin, vl->plugin_instance, vl->type,
+                        vl->type_instance)) {
+        td = te->value;
+        column = dd;
+        break;
+      }
+    }
+  }
 
-          if (index_oid == NULL) {
-            ERROR(PLUGIN_NAME ": Could not allocate memory for index_oid");
-            return -ENOMEM;
-          }
+  /* Scalars are requested by the identifier formatted from their definition
+   * only. */
+  for (llentry_t *de = llist_head(g_agent->scalars); de != NULL;
+       de = de->next) {
+    data_definition_t *dd = de->value;
 
-          int ret = snmp_agent_generate_index(td, vl, index_oid);
+    if (CHECK_DD_TYPE(dd, vl->plugin, vl->plugin_instance, vl->type,
+                      vl->type_instance) &&
+        (snmp_agent_format_name(name, sizeof(name), dd, NULL) == 0) &&
+        (strcmp(name, event->value_list_name) == 0)) {
+      scalar = dd;
+      break;
+    }
+  }
 
-          if (ret == 0)
-            ret = snmp_agent_update_index(dd, td, index_oid, &free_index_oid);
+  if ((column == NULL) && (scalar == NULL))
+    return 0;
 
-          /* Index exists or update failed */
-          if (free_index_oid)
-            sfree(index_oid);
+  /* Receive updates and expiration of this identifier */
+  event->ret = 1;
 
-          return ret;
-        }
-      }
-    }
+  snmp_agent_value_t *v = NULL;
+  if (c_avl_get(g_agent->values, event->value_list_name, (void **)&v) == 0) {
+    /* Restored from a previous run: already known. */
+    memcpy(v->values, vl->values,
+           SNMP_MIN(v->values_num, vl->values_len) * sizeof(*v->values));
+    return 0;
   }
 
-  return 0;
+  v = calloc(1, sizeof(*v) + vl->values_len * sizeof(*v->values));
+  if (v == NULL) {
+    ERROR(PLUGIN_NAME ": Failed to allocate memory");
+    return -ENOMEM;
+  }
+  v->name = strdup(event->value_list_name);
+  if (v->name == NULL) {
+    ERROR(PLUGIN_NAME ": Failed to allocate memory");
+    sfree(v);
+    return -ENOMEM;
+  }
+  v->values_num = vl->values_len;
+  memcpy(v->values, vl->values, vl->values_len * sizeof(*v->values));
+
+  if (c_avl_insert(g_agent->values, v->name, v) != 0) {
+    ERROR(PLUGIN_NAME ": Failed to store values of '%s'", v->name);
+    sfree(v->name);
+    sfree(v);
+    return -ENOMEM;
+  }
+
+  if (scalar != NULL) {
+    v->scalar = scalar;
+    if (scalar->value == NULL)
+      scalar->value = v;
+  }
+
+  if (column == NULL)
+    return 0;
+
+  oid_t *index_oid = calloc(1, sizeof(*index_oid));
+  bool free_index_oid = true;
+
+  if (index_oid == NULL) {
+    ERROR(PLUGIN_NAME ": Could not allocate memory for index_oid");
+    return -ENOMEM;
+  }
+
+  int ret = snmp_agent_generate_index(td, vl, index_oid);
+
+  if (ret == 0)
+    ret = snmp_agent_update_index(column, td, index_oid, &free_index_oid);
+
+  if (ret == 0) {
+    v->dd = column;
+    v->td = td;
+    memcpy(&v->index_oid, index_oid, sizeof(v->index_oid));
+
+    /* Requests for a row are answered with the values of the identifier
+     * formatted from its index, like a cache lookup by this name would. */
+    if ((snmp_agent_format_name(name, sizeof(name), column, index_oid) == 0) &&
+        (strcmp(name, v->name) == 0) &&
+        (c_avl_insert(column->rows, &v->index_oid, v) == 0))
+      v->served = true;
+  }
+
+  /* Index exists or update failed */
+  if (free_index_oid)
+    sfree(index_oid);
+
+  return ret;
+}
+
+/* Removes the expired identifier from the tables and scalars. */
+static void snmp_agent_value_expired(cache_event_t *event) {
+  snmp_agent_value_t *v = NULL;
+
+  if (c_avl_remove(g_agent->values, event->value_list_name, NULL,
+                   (void **)&v) != 0)
+    return;
+
+  if ((v->scalar != NULL) && (v->scalar->value == v))
+    v->scalar->value = NULL;
+
+  if (v->dd != NULL) {
+    if (v->served)
+      c_avl_remove(v->dd->rows, &v->index_oid, NULL, NULL);
+    snmp_agent_table_data_remove(v->dd, v->td, &v->index_oid);
+  }
+
+  sfree(v->name);
+  sfree(v);
 }
 
-static int snmp_agent_collect(const data_set_t *ds, const value_list_t *vl,
-                              user_data_t __attribute__((unused)) * user_data) {
+static int snmp_agent_cache_event(cache_event_t *event,
+                                  user_data_t __attribute__((unused)) * ud) {
+  int ret = 0;
 
   pthread_mutex_lock(&g_agent->lock);
 
-  snmp_agent_write(vl);
+  switch (event->type) {
+  case CE_VALUE_NEW:
+    ret = snmp_agent_value_new(event);
+    break;
+  case CE_VALUE_UPDATE: {
+    snmp_agent_value_t *v = NULL;
+    if (c_avl_get(g_agent->values, event->value_list_name, (void **)&v) == 0)
+      memcpy(v->values, event->value_list->values,
+             SNMP_MIN(v->values_num, event->value_list->values_len) *
+                 sizeof(*v->values));
+    break;
+  }
+  case CE_VALUE_EXPIRED:
+    snmp_agent_value_expired(event);
+    break;
+  }
 
   pthread_mutex_unlock(&g_agent->lock);
 
-  return 0;
+  return ret;
 }
 
 static int snmp_agent_preinit(void) {
@@ -2145,6 +2287,12 @@ static int snmp_agent_init(void) {
 
   plugin_register_shutdown(PLUGIN_NAME, snmp_agent_shutdown);
 
+  g_agent->values = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (g_agent->values == NULL) {
+    ERROR(PLUGIN_NAME ": c_avl_create() failed");
+    return -ENOMEM;
+  }
+
   ret = snmp_agent_register_scalar_oids();
   if (ret != 0)
     return ret;
@@ -2172,10 +2320,7 @@ static int snmp_agent_init(void) {
     return ret;
   }
 
-  if (llist_head(g_agent->tables) != NULL) {
-    plugin_register_write(PLUGIN_NAME, snmp_agent_collect, NULL);
-    plugin_register_missing(PLUGIN_NAME, snmp_agent_clear_missing, NULL);
-  }
+  plugin_register_cache_event(PLUGIN_NAME, snmp_agent_cache_event, NULL);
 
   return 0;
 }
@@ -2280,12 +2425,28 @@ static int snmp_agent_shutdown(void) {
     return -EINVAL;
   }
 
+  plugin_unregister_cache_event(PLUGIN_NAME);
+
   if (pthread_cancel(g_agent->thread) != 0)
     ERROR(PLUGIN_NAME ": snmp_agent_shutdown: failed to cancel the thread");
 
   if (pthread_join(g_agent->thread, NULL) != 0)
     ERROR(PLUGIN_NAME ": snmp_agent_shutdown: failed to join the thread");
 
+  if (g_agent->values != NULL) {
+    void *name;
+    snmp_agent_value_t *v;
+
+    while (c_avl_pick(g_agent->values, &name, (void **)&v) == 0) {
+      sfree(v->name);
+      sfree(v);
+    }
+    c_avl_destroy(g_agent->values);
+    g_agent->values = NULL;
+  }
+  sfree(g_agent->columns);
+  g_agent->columns_num = 0;
+
   snmp_agent_free_config();
 
   snmp_shutdown(PLUGIN_NAME);
@@ -24,6 +24,8 @@
  *   Florian octo Forster <octo at collectd.org>
  */
 
+#define _GNU_SOURCE /* For recvmmsg */
+
 #include "collectd.h"
 
 #include "plugin.h"
@@ -51,8 +53,18 @@
 enum metric_type_e { STATSD_COUNTER, STATSD_TIMER, STATSD_GAUGE, STATSD_SET };
 typedef enum metric_type_e metric_type_t;
 
-struct statsd_metric_s {
+/* Identifies a metric in a statsd_map_t. `name' points into the map's
+ * arena. */
+struct statsd_key_s {
+  char const *name;
+  size_t name_len;
+  uint32_t hash;
   metric_type_t type;
+};
+typedef struct statsd_key_s statsd_key_t;
+
+struct statsd_metric_s {
+  statsd_key_t key;
   double value;
   derive_t counter;
   latency_counter_t *latency;
@@ -61,15 +73,92 @@ struct statsd_metric_s {
 };
 typedef struct statsd_metric_s statsd_metric_t;
 
-static c_avl_tree_t *metrics_tree;
+/* Changes to one metric seen by one receive thread since the last read. For
+ * gauges, `value_set' tells whether `value' replaces the metric's value or is
+ * added to it. */
+struct statsd_delta_s {
+  statsd_key_t key;
+  double value;
+  bool value_set;
+  latency_counter_t *latency;
+  c_avl_tree_t *set;
+  unsigned long updates_num;
+};
+typedef struct statsd_delta_s statsd_delta_t;
+
+/* Names are copied into large blocks instead of being allocated one by one.
+ * The space of removed names is reclaimed by statsd_map_compact(). */
+struct statsd_arena_block_s {
+  struct statsd_arena_block_s *next;
+  size_t used;
+  size_t size;
+  char data[];
+};
+typedef struct statsd_arena_block_s statsd_arena_block_t;
+
+/* Open-addressing hash map with linear probing. The entries, which start with
+ * a statsd_key_t, are stored in a dense array so that iterating over them is
+ * cheap; the slots hold the hash and the index of an entry plus one, zero
+ * meaning the slot is free. Removing an entry moves the last entry into its
+ * place and shifts the following slots back, so there are no tombstones.
+ * Inserting or removing entries moves entries, invalidating pointers to
+ * them. */
+struct statsd_map_slot_s {
+  uint32_t hash;
+  uint32_t index;
+};
+typedef struct statsd_map_slot_s statsd_map_slot_t;
+
+struct statsd_map_s {
+  statsd_map_slot_t *slots;
+  size_t slots_num;
+
+  char *entries;
+  size_t entry_size;
+  size_t entries_num;
+  size_t entries_size;
+
+  statsd_arena_block_t *arena;
+  size_t arena_live;
+  size_t arena_dead;
+};
+typedef struct statsd_map_s statsd_map_t;
+
+#define STATSD_MAP_INIT(type)                                                  \
+  { .entry_size = sizeof(type) }
+#define STATSD_MAP_ENTRY(m, i) ((void *)((m)->entries + (i) * (m)->entry_size))
+
+/* Every receive thread has its own copy of the listen sockets and aggregates
+ * the lines it receives in its own map, which statsd_read() merges into
+ * `metrics'. With more than one thread the sockets are bound with
+ * SO_REUSEPORT, so that the kernel spreads the senders over the threads.
+ * `lock' is held while a batch of datagrams is parsed and while merging, i.e.
+ * it is only contended once per interval. */
+struct statsd_receiver_s {
+  pthread_t thread;
+  bool thread_running;
+
+  pthread_mutex_t lock;
+  statsd_map_t deltas;
+};
+typedef struct statsd_receiver_s statsd_receiver_t;
+
+/* Maximum number of datagrams received with one recvmmsg(2) call. */
+#define STATSD_RECEIVE_BATCH 32
+#define STATSD_DATAGRAM_SIZE 4096
+#define STATSD_MAP_SLOTS_MIN 256
+#define STATSD_ARENA_BLOCK_SIZE 65536
+
+static statsd_map_t metrics = STATSD_MAP_INIT(statsd_metric_t);
 static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
 
-static pthread_t network_thread;
-static bool network_thread_running;
+static statsd_receiver_t *receivers;
+static size_t receivers_num;
 static bool network_thread_shutdown;
 
 static char *conf_node;
 static char *conf_service;
+static size_t conf_receive_threads = 1;
 
 static bool conf_delete_counters;
 static bool conf_delete_timers;
@@ -85,111 +174,294 @@ static bool conf_timer_upper;
 static bool conf_timer_sum;
 static bool conf_timer_count;
 
-/* Must hold metrics_lock when calling this function. */
-static statsd_metric_t *statsd_metric_lookup_unsafe(char const *name, /* {{{ */
-                                                    metric_type_t type) {
-  char key[DATA_MAX_NAME_LEN + 2];
-  char *key_copy;
-  statsd_metric_t *metric;
-  int status;
+/* FNV-1a over the type and the name. */
+static uint32_t statsd_hash(char const *name, size_t name_len, /* {{{ */
+                            metric_type_t type) {
+  uint32_t hash = 2166136261u;
 
-  switch (type) {
-  case STATSD_COUNTER:
-    key[0] = 'c';
-    break;
-  case STATSD_TIMER:
-    key[0] = 't';
-    break;
-  case STATSD_GAUGE:
-    key[0] = 'g';
-    break;
-  case STATSD_SET:
-    key[0] = 's';
-    break;
-  default:
-    return NULL;
+  hash ^= (uint8_t)type;
+  hash *= 16777619u;
+  for (size_t i = 0; i < name_len; i++) {
+    hash ^= (uint8_t)name[i];
+    hash *= 16777619u;
   }
 
-  key[1] = ':';
-  sstrncpy(&key[2], name, sizeof(key) - 2);
+  return hash;
+} /* }}} uint32_t statsd_hash */
 
-  status = c_avl_get(metrics_tree, key, (void *)&metric);
-  if (status == 0)
-    return metric;
+static char const *statsd_arena_strndup(statsd_map_t *m, /* {{{ */
+                                        char const *name, size_t name_len) {
+  statsd_arena_block_t *b = m->arena;
 
-  key_copy = strdup(key);
-  if (key_copy == NULL) {
-    ERROR("statsd plugin: strdup failed.");
-    return NULL;
+  if ((b == NULL) || ((b->size - b->used) < (name_len + 1))) {
+    size_t size = STATSD_ARENA_BLOCK_SIZE;
+    if (size < (name_len + 1))
+      size = name_len + 1;
+
+    b = malloc(sizeof(*b) + size);
+    if (b == NULL) {
+      ERROR("statsd plugin: malloc failed.");
+      return NULL;
+    }
+    b->used = 0;
+    b->size = size;
+    b->next = m->arena;
+    m->arena = b;
   }
 
-  metric = calloc(1, sizeof(*metric));
-  if (metric == NULL) {
+  char *copy = b->data + b->used;
+  memcpy(copy, name, name_len);
+  copy[name_len] = 0;
+  b->used += name_len + 1;
+  m->arena_live += name_len + 1;
+
+  return copy;
+} /* }}} char const *statsd_arena_strndup */
+
+static void statsd_arena_free(statsd_arena_block_t *b) /* {{{ */
+{
+  while (b != NULL) {
+    statsd_arena_block_t *next = b->next;
+    sfree(b);
+    b = next;
+  }
+} /* }}} void statsd_arena_free */
+
+/* Copies the names of all entries into a new arena once more than half of
+ * the arena is taken up by removed names. */
+static void statsd_map_compact(statsd_map_t *m) /* {{{ */
+{
+  if ((m->arena_dead < STATSD_ARENA_BLOCK_SIZE) ||
+      (m->arena_dead < m->arena_live))
+    return;
+
+  statsd_arena_block_t *old = m->arena;
+  m->arena = NULL;
+  m->arena_live = 0;
+  m->arena_dead = 0;
+
+  for (size_t i = 0; i < m->entries_num; i++) {
+    statsd_key_t *key = STATSD_MAP_ENTRY(m, i);
+    char const *name = statsd_arena_strndup(m, key->name, key->name_len);
+    if (name == NULL) {
+      /* Keep the old blocks, some names are still in there. */
+      if (m->arena == NULL) {
+        m->arena = old;
+      } else {
+        statsd_arena_block_t *b = m->arena;
+        while (b->next != NULL)
+          b = b->next;
+        b->next = old;
+      }
+
+      size_t used = 0;
+      for (statsd_arena_block_t *b = m->arena; b != NULL; b = b->next)
+        used += b->used;
+      m->arena_live = 0;
+      for (size_t j = 0; j < m->entries_num; j++)
+        m->arena_live += ((statsd_key_t *)STATSD_MAP_ENTRY(m, j))->name_len + 1;
+      m->arena_dead = used - m->arena_live;
+      return;
+    }
+    key->name = name;
+  }
+
+  statsd_arena_free(old);
+} /* }}} void statsd_map_compact */
+
+static int statsd_map_grow(statsd_map_t *m) /* {{{ */
+{
+  size_t slots_num =
+      (m->slots_num == 0) ? STATSD_MAP_SLOTS_MIN : 2 * m->slots_num;
+  statsd_map_slot_t *slots = calloc(slots_num, sizeof(*slots));
+  if (slots == NULL) {
     ERROR("statsd plugin: calloc failed.");
-    sfree(key_copy);
+    return ENOMEM;
+  }
+
+  for (size_t i = 0; i < m->slots_num; i++) {
+    if (m->slots[i].index == 0)
+      continue;
+
+    size_t j = m->slots[i].hash & (slots_num - 1);
+    while (slots[j].index != 0)
+      j = (j + 1) & (slots_num - 1);
+    slots[j] = m->slots[i];
+  }
+
+  sfree(m->slots);
+  m->slots = slots;
+  m->slots_num = slots_num;
+  return 0;
+} /* }}} int statsd_map_grow */
+
+/* Returns the entry for `name' and `type', or NULL if there is none and
+ * `create' is false. New entries are zeroed, apart from the key. Names are
+ * truncated like the type instances they end up in. */
+static void *statsd_map_get(statsd_map_t *m, char const *name, /* {{{ */
+                            metric_type_t type, bool create) {
+  size_t name_len = strnlen(name, DATA_MAX_NAME_LEN - 1);
+  uint32_t hash = statsd_hash(name, name_len, type);
+  size_t mask = m->slots_num - 1;
+  size_t i = hash & mask;
+
+  for (; (m->slots_num > 0) && (m->slots[i].index != 0); i = (i + 1) & mask) {
+    if (m->slots[i].hash != hash)
+      continue;
+
+    statsd_key_t *key = STATSD_MAP_ENTRY(m, m->slots[i].index - 1);
+    if ((key->type == type) && (key->name_len == name_len) &&
+        (memcmp(key->name, name, name_len) == 0))
+      return key;
+  }
+
+  if (!create)
     return NULL;
+
+  /* Keep the load factor at or below 1/2. */
+  if ((2 * (m->entries_num + 1)) > m->slots_num) {
+    if ((statsd_map_grow(m) != 0) &&
+        ((m->slots_num == 0) || ((m->entries_num + 1) >= m->slots_num)))
+      return NULL;
+    mask = m->slots_num - 1;
+    for (i = hash & mask; m->slots[i].index != 0; i = (i + 1) & mask)
+      ;
   }
 
-  metric->type = type;
-  metric->latency = NULL;
-  metric->set = NULL;
+  if (m->entries_num == m->entries_size) {
+    size_t size = (m->entries_size == 0) ? 64 : 2 * m->entries_size;
+    char *tmp = realloc(m->entries, size * m->entry_size);
+    if (tmp == NULL) {
+      ERROR("statsd plugin: realloc failed.");
+      return NULL;
+    }
+    m->entries = tmp;
+    m->entries_size = size;
+  }
 
-  status = c_avl_insert(metrics_tree, key_copy, metric);
-  if (status != 0) {
-    ERROR("statsd plugin: c_avl_insert failed.");
-    sfree(key_copy);
-    sfree(metric);
+  char const *name_copy = statsd_arena_strndup(m, name, name_len);
+  if (name_copy == NULL)
     return NULL;
+
+  statsd_key_t *key = STATSD_MAP_ENTRY(m, m->entries_num);
+  memset(key, 0, m->entry_size);
+  *key = (statsd_key_t){
+      .name = name_copy,
+      .name_len = name_len,
+      .hash = hash,
+      .type = type,
+  };
+
+  m->entries_num++;
+  m->slots[i] = (statsd_map_slot_t){.hash = hash,
+                                    .index = (uint32_t)m->entries_num};
+
+  return key;
+} /* }}} void *statsd_map_get */
+
+/* Returns the slot pointing to entry `index'. */
+static size_t statsd_map_slot(statsd_map_t const *m, size_t index) /* {{{ */
+{
+  statsd_key_t const *key = STATSD_MAP_ENTRY(m, index);
+  size_t mask = m->slots_num - 1;
+  size_t i = key->hash & mask;
+
+  while (m->slots[i].index != index + 1)
+    i = (i + 1) & mask;
+  return i;
+} /* }}} size_t statsd_map_slot */
+
+/* Removes entry `index'. The last entry takes its place, so when removing
+ * entries while iterating, iterate backwards. The caller is responsible for
+ * any resources the entry holds apart from its name. */
+static void statsd_map_remove(statsd_map_t *m, size_t index) /* {{{ */
+{
+  size_t mask = m->slots_num - 1;
+  size_t i = statsd_map_slot(m, index);
+  size_t last = m->entries_num - 1;
+  statsd_key_t *key = STATSD_MAP_ENTRY(m, index);
+
+  m->arena_live -= key->name_len + 1;
+  m->arena_dead += key->name_len + 1;
+
+  /* Shift back the entries following the removed one in its probe sequence,
+   * unless that would move them before their home slot. */
+  for (size_t j = (i + 1) & mask; m->slots[j].index != 0; j = (j + 1) & mask) {
+    size_t home = m->slots[j].hash & mask;
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      m->slots[i] = m->slots[j];
+      i = j;
+    }
   }
+  m->slots[i] = (statsd_map_slot_t){0};
 
-  return metric;
-} /* }}} statsd_metric_lookup_unsafe */
+  if (index != last) {
+    m->slots[statsd_map_slot(m, last)].index = (uint32_t)(index + 1);
+    memcpy(key, STATSD_MAP_ENTRY(m, last), m->entry_size);
+  }
+  m->entries_num--;
+} /* }}} void statsd_map_remove */
 
-static int statsd_metric_set(char const *name, double value, /* {{{ */
-                             metric_type_t type) {
-  statsd_metric_t *metric;
+static void statsd_map_destroy(statsd_map_t *m) /* {{{ */
+{
+  sfree(m->slots);
+  m->slots_num = 0;
+  sfree(m->entries);
+  m->entries_num = 0;
+  m->entries_size = 0;
+  statsd_arena_free(m->arena);
+  m->arena = NULL;
+  m->arena_live = 0;
+  m->arena_dead = 0;
+} /* }}} void statsd_map_destroy */
+
+/* Frees the resources held by a delta, but not the entry itself. */
+static void statsd_delta_free(statsd_delta_t *d) /* {{{ */
+{
+  latency_counter_destroy(d->latency);
+  d->latency = NULL;
 
-  pthread_mutex_lock(&metrics_lock);
+  if (d->set != NULL) {
+    void *key;
+    void *value;
 
-  metric = statsd_metric_lookup_unsafe(name, type);
-  if (metric == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
-    return -1;
+    while (c_avl_pick(d->set, &key, &value) == 0)
+      sfree(key);
+    c_avl_destroy(d->set);
+    d->set = NULL;
   }
+} /* }}} void statsd_delta_free */
 
-  metric->value = value;
-  metric->updates_num++;
+static int statsd_metric_set(statsd_receiver_t *r, /* {{{ */
+                             char const *name, double value,
+                             metric_type_t type) {
+  statsd_delta_t *d = statsd_map_get(&r->deltas, name, type, true);
+  if (d == NULL)
+    return -1;
 
-  pthread_mutex_unlock(&metrics_lock);
+  d->value = value;
+  d->value_set = true;
+  d->updates_num++;
 
   return 0;
 } /* }}} int statsd_metric_set */
 
-static int statsd_metric_add(char const *name, double delta, /* {{{ */
+static int statsd_metric_add(statsd_receiver_t *r, /* {{{ */
+                             char const *name, double delta,
                              metric_type_t type) {
-  statsd_metric_t *metric;
-
-  pthread_mutex_lock(&metrics_lock);
-
-  metric = statsd_metric_lookup_unsafe(name, type);
-  if (metric == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
+  statsd_delta_t *d = statsd_map_get(&r->deltas, name, type, true);
+  if (d == NULL)
     return -1;
-  }
 
-  metric->value += delta;
-  metric->updates_num++;
-
-  pthread_mutex_unlock(&metrics_lock);
+  d->value += delta;
+  d->updates_num++;
 
   return 0;
 } /* }}} int statsd_metric_add */
 
+/* Frees the resources held by a metric, but not the entry itself. */
 static void statsd_metric_free(statsd_metric_t *metric) /* {{{ */
 {
-  if (metric == NULL)
-    return;
-
   if (metric->latency != NULL) {
     latency_counter_destroy(metric->latency);
     metric->latency = NULL;
@@ -207,8 +479,6 @@ static void statsd_metric_free(statsd_metric_t *metric) /* {{{ */
     c_avl_destroy(metric->set);
     metric->set = NULL;
   }
-
-  sfree(metric);
 } /* }}} void statsd_metric_free */
 
 static int statsd_parse_value(char const *str, value_t *ret_value) /* {{{ */
@@ -222,8 +492,9 @@ static int statsd_parse_value(char const *str, value_t *ret_value) /* {{{ */
   return 0;
 } /* }}} int statsd_parse_value */
 
-static int statsd_handle_counter(char const *name, /* {{{ */
-                                 char const *value_str, char const *extra) {
+static int statsd_handle_counter(statsd_receiver_t *r, /* {{{ */
+                                 char const *name, char const *value_str,
+                                 char const *extra) {
   value_t value;
   value_t scale;
   int status;
@@ -248,12 +519,12 @@ static int statsd_handle_counter(char const *name, /* {{{ */
 
   /* Changes to the counter are added to (statsd_metric_t*)->value. ->counter is
    * only updated in statsd_metric_submit_unsafe(). */
-  return statsd_metric_add(name, (double)(value.gauge / scale.gauge),
+  return statsd_metric_add(r, name, (double)(value.gauge / scale.gauge),
                            STATSD_COUNTER);
 } /* }}} int statsd_handle_counter */
 
-static int statsd_handle_gauge(char const *name, /* {{{ */
-                               char const *value_str) {
+static int statsd_handle_gauge(statsd_receiver_t *r, /* {{{ */
+                               char const *name, char const *value_str) {
   value_t value;
   int status;
 
@@ -263,14 +534,15 @@ static int statsd_handle_gauge(char const *name, /* {{{ */
     return status;
 
   if ((value_str[0] == '+') || (value_str[0] == '-'))
-    return statsd_metric_add(name, (double)value.gauge, STATSD_GAUGE);
+    return statsd_metric_add(r, name, (double)value.gauge, STATSD_GAUGE);
   else
-    return statsd_metric_set(name, (double)value.gauge, STATSD_GAUGE);
+    return statsd_metric_set(r, name, (double)value.gauge, STATSD_GAUGE);
 } /* }}} int statsd_handle_gauge */
 
-static int statsd_handle_timer(char const *name, /* {{{ */
-                               char const *value_str, char const *extra) {
-  statsd_metric_t *metric;
+static int statsd_handle_timer(statsd_receiver_t *r, /* {{{ */
+                               char const *name, char const *value_str,
+                               char const *extra) {
+  statsd_delta_t *d;
   value_t value_ms;
   value_t scale;
   cdtime_t value;
@@ -296,62 +568,48 @@ static int statsd_handle_timer(char const *name, /* {{{ */
 
   value = MS_TO_CDTIME_T(value_ms.gauge / scale.gauge);
 
-  pthread_mutex_lock(&metrics_lock);
-
-  metric = statsd_metric_lookup_unsafe(name, STATSD_TIMER);
-  if (metric == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
+  d = statsd_map_get(&r->deltas, name, STATSD_TIMER, true);
+  if (d == NULL)
     return -1;
-  }
 
-  if (metric->latency == NULL)
-    metric->latency = latency_counter_create();
-  if (metric->latency == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
+  if (d->latency == NULL)
+    d->latency = latency_counter_create();
+  if (d->latency == NULL)
     return -1;
-  }
 
-  latency_counter_add(metric->latency, value);
-  metric->updates_num++;
+  latency_counter_add(d->latency, value);
+  d->updates_num++;
 
-  pthread_mutex_unlock(&metrics_lock);
   return 0;
 } /* }}} int statsd_handle_timer */
 
-static int statsd_handle_set(char const *name, /* {{{ */
-                             char const *set_key_orig) {
-  statsd_metric_t *metric = NULL;
+static int statsd_handle_set(statsd_receiver_t *r, /* {{{ */
+                             char const *name, char const *set_key_orig) {
+  statsd_delta_t *d;
   char *set_key;
   int status;
 
-  pthread_mutex_lock(&metrics_lock);
-
-  metric = statsd_metric_lookup_unsafe(name, STATSD_SET);
-  if (metric == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
+  d = statsd_map_get(&r->deltas, name, STATSD_SET, true);
+  if (d == NULL)
     return -1;
-  }
 
-  /* Make sure metric->set exists. */
-  if (metric->set == NULL)
-    metric->set = c_avl_create((int (*)(const void *, const void *))strcmp);
+  /* Make sure d->set exists. */
+  if (d->set == NULL)
+    d->set = c_avl_create((int (*)(const void *, const void *))strcmp);
 
-  if (metric->set == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
+  if (d->set == NULL) {
     ERROR("statsd plugin: c_avl_create failed.");
     return -1;
   }
 
   set_key = strdup(set_key_orig);
   if (set_key == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
     ERROR("statsd plugin: strdup failed.");
     return -1;
   }
 
-  status = c_avl_insert(metric->set, set_key, /* value = */ NULL);
+  status = c_avl_insert(d->set, set_key, /* value = */ NULL);
   if (status < 0) {
-    pthread_mutex_unlock(&metrics_lock);
     ERROR("statsd plugin: c_avl_insert (\"%s\") failed with status %i.",
           set_key, status);
     sfree(set_key);
@@ -361,13 +619,12 @@ static int statsd_handle_set(char const *name, /* {{{ */
     sfree(set_key);
   }
 
-  metric->updates_num++;
+  d->updates_num++;
 
-  pthread_mutex_unlock(&metrics_lock);
   return 0;
 } /* }}} int statsd_handle_set */
 
-static int statsd_parse_line(char *buffer) /* {{{ */
+static int statsd_parse_line(statsd_receiver_t *r, char *buffer) /* {{{ */
 {
   char *name = buffer;
   char *value;
@@ -393,23 +650,24 @@ static int statsd_parse_line(char *buffer) /* {{{ */
   }
 
   if (strcmp("c", type) == 0)
-    return statsd_handle_counter(name, value, extra);
+    return statsd_handle_counter(r, name, value, extra);
   else if (strcmp("ms", type) == 0)
-    return statsd_handle_timer(name, value, extra);
+    return statsd_handle_timer(r, name, value, extra);
 
   /* extra is only valid for counters and timers */
   if (extra != NULL)
     return -1;
 
   if (strcmp("g", type) == 0)
-    return statsd_handle_gauge(name, value);
+    return statsd_handle_gauge(r, name, value);
   else if (strcmp("s", type) == 0)
-    return statsd_handle_set(name, value);
+    return statsd_handle_set(r, name, value);
   else
     return -1;
 } /* }}} void statsd_parse_line */
 
-static void statsd_parse_buffer(char *buffer) /* {{{ */
+/* Must hold r->lock when calling this function. */
+static void statsd_parse_buffer(statsd_receiver_t *r, char *buffer) /* {{{ */
 {
   while (buffer != NULL) {
     char orig[64];
@@ -429,7 +687,7 @@ static void statsd_parse_buffer(char *buffer) /* {{{ */
 
     sstrncpy(orig, buffer, sizeof(orig));
 
-    status = statsd_parse_line(buffer);
+    status = statsd_parse_line(r, buffer);
     if (status != 0)
       ERROR("statsd plugin: Unable to parse line: \"%s\"", orig);
 
@@ -437,13 +695,48 @@ static void statsd_parse_buffer(char *buffer) /* {{{ */
   }
 } /* }}} void statsd_parse_buffer */
 
-static void statsd_network_read(int fd) /* {{{ */
-{
-  char buffer[4096];
-  size_t buffer_size;
-  ssize_t status;
+/* Receives a batch of datagrams from `fd' into `buffers' and parses them. */
+static void statsd_network_read(statsd_receiver_t *r, int fd, /* {{{ */
+                                char *buffers) {
+  size_t sizes[STATSD_RECEIVE_BATCH];
+  size_t num;
+
+#if HAVE_RECVMMSG
+  struct mmsghdr msgs[STATSD_RECEIVE_BATCH];
+  struct iovec iovs[STATSD_RECEIVE_BATCH];
+
+  for (size_t i = 0; i < STATSD_RECEIVE_BATCH; i++) {
+    /* Leave room for the terminating null byte. */
+    iovs[i] = (struct iovec){
+        .iov_base = buffers + i * STATSD_DATAGRAM_SIZE,
+        .iov_len = STATSD_DATAGRAM_SIZE - 1,
+    };
+    msgs[i] = (struct mmsghdr){
+        .msg_hdr =
+            {
+                .msg_iov = iovs + i,
+                .msg_iovlen = 1,
+            },
+    };
+  }
+
+  int status = recvmmsg(fd, msgs, STATSD_RECEIVE_BATCH,
+                        /* flags = */ MSG_DONTWAIT, /* timeout = */ NULL);
+  if (status < 0) {
+
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+      return;
+
+    ERROR("statsd plugin: recvmmsg(2) failed: %s", STRERRNO);
+    return;
+  }
 
-  status = recv(fd, buffer, sizeof(buffer), /* flags = */ MSG_DONTWAIT);
+  num = (size_t)status;
+  for (size_t i = 0; i < num; i++)
+    sizes[i] = (size_t)msgs[i].msg_len;
+#else
+  ssize_t status = recv(fd, buffers, STATSD_DATAGRAM_SIZE - 1,
+                        /* flags = */ MSG_DONTWAIT);
   if (status < 0) {
 
     if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
@@ -453,16 +746,22 @@ static void statsd_network_read(int fd) /* {{{ */
     return;
   }
 
-  buffer_size = (size_t)status;
-  if (buffer_size >= sizeof(buffer))
-    buffer_size = sizeof(buffer) - 1;
-  buffer[buffer_size] = 0;
+  num = 1;
+  sizes[0] = (size_t)status;
+#endif
+
+  pthread_mutex_lock(&r->lock);
+  for (size_t i = 0; i < num; i++) {
+    char *buffer = buffers + i * STATSD_DATAGRAM_SIZE;
 
-  statsd_parse_buffer(buffer);
+    buffer[sizes[i]] = 0;
+    statsd_parse_buffer(r, buffer);
+  }
+  pthread_mutex_unlock(&r->lock);
 } /* }}} void statsd_network_read */
 
 static int statsd_network_init(struct pollfd **ret_fds, /* {{{ */
-                               size_t *ret_fds_num) {
+                               size_t *ret_fds_num, bool reuseport) {
   struct pollfd *fds = NULL;
   size_t fds_num = 0;
 
@@ -506,6 +805,18 @@ static int statsd_network_init(struct pollfd **ret_fds, /* {{{ */
       continue;
     }
 
+#ifdef SO_REUSEPORT
+    /* let the kernel balance the datagrams over the receive threads */
+    if (reuseport &&
+        (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) == -1)) {
+      ERROR("statsd plugin: setsockopt (reuseport): %s", STRERRNO);
+      close(fd);
+      continue;
+    }
+#else
+    assert(!reuseport);
+#endif
+
     getnameinfo(ai_ptr->ai_addr, ai_ptr->ai_addrlen, str_node, sizeof(str_node),
                 str_service, sizeof(str_service),
                 NI_DGRAM | NI_NUMERICHOST | NI_NUMERICSERV);
@@ -551,13 +862,21 @@ static int statsd_network_init(struct pollfd **ret_fds, /* {{{ */
 
 static void *statsd_network_thread(void *args) /* {{{ */
 {
+  statsd_receiver_t *r = args;
   struct pollfd *fds = NULL;
   size_t fds_num = 0;
   int status;
 
-  status = statsd_network_init(&fds, &fds_num);
+  char *buffers = malloc(STATSD_RECEIVE_BATCH * STATSD_DATAGRAM_SIZE);
+  if (buffers == NULL) {
+    ERROR("statsd plugin: malloc failed.");
+    pthread_exit((void *)0);
+  }
+
+  status = statsd_network_init(&fds, &fds_num, receivers_num > 1);
   if (status != 0) {
     ERROR("statsd plugin: Unable to open listening sockets.");
+    sfree(buffers);
     pthread_exit((void *)0);
   }
 
@@ -576,7 +895,7 @@ static void *statsd_network_thread(void *args) /* {{{ */
       if ((fds[i].revents & (POLLIN | POLLPRI)) == 0)
         continue;
 
-      statsd_network_read(fds[i].fd);
+      statsd_network_read(r, fds[i].fd, buffers);
       fds[i].revents = 0;
     }
   } /* while (!network_thread_shutdown) */
@@ -585,6 +904,7 @@ static void *statsd_network_thread(void *args) /* {{{ */
   for (size_t i = 0; i < fds_num; i++)
     close(fds[i].fd);
   sfree(fds);
+  sfree(buffers);
 
   return (void *)0;
 } /* }}} void *statsd_network_thread */
@@ -619,6 +939,31 @@ static int statsd_config_timer_percentile(oconfig_item_t *ci) /* {{{ */
   return 0;
 } /* }}} int statsd_config_timer_percentile */
 
+static int statsd_config_receive_threads(oconfig_item_t *ci) /* {{{ */
+{
+  int tmp = 0;
+
+  if (cf_util_get_int(ci, &tmp) != 0)
+    return -1;
+
+  if (tmp < 1) {
+    ERROR("statsd plugin: The \"%s\" option must be positive.", ci->key);
+    return ERANGE;
+  }
+
+#ifndef SO_REUSEPORT
+  if (tmp > 1) {
+    WARNING("statsd plugin: \"%s\" requires SO_REUSEPORT, which is not "
+            "available on this system. Using one receive thread.",
+            ci->key);
+    tmp = 1;
+  }
+#endif
+
+  conf_receive_threads = (size_t)tmp;
+  return 0;
+} /* }}} int statsd_config_receive_threads */
+
 static int statsd_config(oconfig_item_t *ci) /* {{{ */
 {
   for (int i = 0; i < ci->children_num; i++) {
@@ -628,6 +973,8 @@ static int statsd_config(oconfig_item_t *ci) /* {{{ */
       cf_util_get_string(child, &conf_node);
     else if (strcasecmp("Port", child->key) == 0)
       cf_util_get_service(child, &conf_service);
+    else if (strcasecmp("ReceiveThreads", child->key) == 0)
+      statsd_config_receive_threads(child);
     else if (strcasecmp("DeleteCounters", child->key) == 0)
       cf_util_get_boolean(child, &conf_delete_counters);
     else if (strcasecmp("DeleteTimers", child->key) == 0)
@@ -659,22 +1006,39 @@ static int statsd_config(oconfig_item_t *ci) /* {{{ */
 static int statsd_init(void) /* {{{ */
 {
   pthread_mutex_lock(&metrics_lock);
-  if (metrics_tree == NULL)
-    metrics_tree = c_avl_create((int (*)(const void *, const void *))strcmp);
 
-  if (!network_thread_running) {
+  if (receivers == NULL) {
+    receivers = calloc(conf_receive_threads, sizeof(*receivers));
+    if (receivers == NULL) {
+      pthread_mutex_unlock(&metrics_lock);
+      ERROR("statsd plugin: calloc failed.");
+      return ENOMEM;
+    }
+    receivers_num = conf_receive_threads;
+
+    for (size_t i = 0; i < receivers_num; i++) {
+      pthread_mutex_init(&receivers[i].lock, /* attr = */ NULL);
+      receivers[i].deltas =
+          (statsd_map_t)STATSD_MAP_INIT(statsd_delta_t);
+    }
+  }
+
+  for (size_t i = 0; i < receivers_num; i++) {
+    statsd_receiver_t *r = receivers + i;
     int status;
 
-    status = pthread_create(&network_thread,
-                            /* attr = */ NULL, statsd_network_thread,
-                            /* args = */ NULL);
+    if (r->thread_running)
+      continue;
+
+    status = plugin_thread_create(&r->thread, statsd_network_thread,
+                                  /* args = */ r, "statsd recv");
     if (status != 0) {
       pthread_mutex_unlock(&metrics_lock);
       ERROR("statsd plugin: pthread_create failed: %s", STRERRNO);
       return status;
     }
+    r->thread_running = true;
   }
-  network_thread_running = true;
 
   pthread_mutex_unlock(&metrics_lock);
 
@@ -687,7 +1051,7 @@ static int statsd_metric_clear_set_unsafe(statsd_metric_t *metric) /* {{{ */
   void *key;
   void *value;
 
-  if ((metric == NULL) || (metric->type != STATSD_SET))
+  if ((metric == NULL) || (metric->key.type != STATSD_SET))
     return EINVAL;
 
   if (metric->set == NULL)
@@ -711,20 +1075,20 @@ static int statsd_metric_submit_unsafe(char const *name,
   vl.values_len = 1;
   sstrncpy(vl.plugin, "statsd", sizeof(vl.plugin));
 
-  if (metric->type == STATSD_GAUGE)
+  if (metric->key.type == STATSD_GAUGE)
     sstrncpy(vl.type, "gauge", sizeof(vl.type));
-  else if (metric->type == STATSD_TIMER)
+  else if (metric->key.type == STATSD_TIMER)
     sstrncpy(vl.type, "latency", sizeof(vl.type));
-  else if (metric->type == STATSD_SET)
+  else if (metric->key.type == STATSD_SET)
     sstrncpy(vl.type, "objects", sizeof(vl.type));
-  else /* if (metric->type == STATSD_COUNTER) */
+  else /* if (metric->key.type == STATSD_COUNTER) */
     sstrncpy(vl.type, "derive", sizeof(vl.type));
 
   sstrncpy(vl.type_instance, name, sizeof(vl.type_instance));
 
-  if (metric->type == STATSD_GAUGE)
+  if (metric->key.type == STATSD_GAUGE)
     vl.values[0].gauge = (gauge_t)metric->value;
-  else if (metric->type == STATSD_TIMER) {
+  else if (metric->key.type == STATSD_TIMER) {
     bool have_events = (metric->updates_num > 0);
 
     /* Make sure all timer metrics share the *same* timestamp. */
@@ -785,7 +1149,7 @@ static int statsd_metric_submit_unsafe(char const *name,
 
     latency_counter_reset(metric->latency);
     return 0;
-  } else if (metric->type == STATSD_SET) {
+  } else if (metric->key.type == STATSD_SET) {
     if (metric->set == NULL)
       vl.values[0].gauge = 0.0;
     else
@@ -817,87 +1181,154 @@ static int statsd_metric_submit_unsafe(char const *name,
   return plugin_dispatch_values(&vl);
 } /* }}} int statsd_metric_submit_unsafe */
 
-static int statsd_read(void) /* {{{ */
+/* Adds the changes in `d' to `metric'. */
+static void statsd_delta_merge_unsafe(statsd_metric_t *metric, /* {{{ */
+                                      statsd_delta_t *d) {
+  switch (d->key.type) {
+  case STATSD_GAUGE:
+    if (d->value_set)
+      metric->value = d->value;
+    else
+      metric->value += d->value;
+    break;
+  case STATSD_TIMER:
+    if (d->latency == NULL)
+      break;
+    if (metric->latency == NULL)
+      metric->latency = latency_counter_create();
+    latency_counter_merge(metric->latency, d->latency);
+    break;
+  case STATSD_SET:
+    if (d->set == NULL)
+      break;
+    if (metric->set == NULL)
+      metric->set = c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (metric->set == NULL) {
+      ERROR("statsd plugin: c_avl_create failed.");
+      break;
+    }
+
+    /* Move the keys, dropping those the metric already has. */
+    char *key;
+    void *value;
+    while (c_avl_pick(d->set, (void *)&key, &value) == 0)
+      if (c_avl_insert(metric->set, key, /* value = */ NULL) != 0)
+        sfree(key);
+    break;
+  default: /* STATSD_COUNTER */
+    metric->value += d->value;
+  }
+
+  metric->updates_num += d->updates_num;
+} /* }}} void statsd_delta_merge_unsafe */
+
+/* Merges the receiver's deltas into `metrics' and resets them. Deltas which
+ * have not been updated for a whole interval are removed. Must hold
+ * metrics_lock and r->lock when calling this function. */
+static void statsd_receiver_merge_unsafe(statsd_receiver_t *r) /* {{{ */
 {
-  c_avl_iterator_t *iter;
-  char *name;
-  statsd_metric_t *metric;
+  statsd_map_t *m = &r->deltas;
 
-  char **to_be_deleted = NULL;
-  size_t to_be_deleted_num = 0;
+  /* Backwards, see statsd_map_remove(). */
+  for (size_t i = m->entries_num; i > 0; i--) {
+    statsd_delta_t *d = STATSD_MAP_ENTRY(m, i - 1);
+
+    if (d->updates_num == 0) {
+      statsd_delta_free(d);
+      statsd_map_remove(m, i - 1);
+      continue;
+    }
 
+    statsd_metric_t *metric =
+        statsd_map_get(&metrics, d->key.name, d->key.type, true);
+    if (metric != NULL)
+      statsd_delta_merge_unsafe(metric, d);
+
+    d->value = 0.0;
+    d->value_set = false;
+    if (d->latency != NULL)
+      latency_counter_reset(d->latency);
+    if (d->set != NULL) {
+      char *key;
+      void *value;
+      while (c_avl_pick(d->set, (void *)&key, &value) == 0)
+        sfree(key);
+    }
+    d->updates_num = 0;
+  }
+
+  statsd_map_compact(m);
+} /* }}} void statsd_receiver_merge_unsafe */
+
+static int statsd_read(void) /* {{{ */
+{
   pthread_mutex_lock(&metrics_lock);
 
-  if (metrics_tree == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
-    return 0;
+  for (size_t i = 0; i < receivers_num; i++) {
+    pthread_mutex_lock(&receivers[i].lock);
+    statsd_receiver_merge_unsafe(receivers + i);
+    pthread_mutex_unlock(&receivers[i].lock);
   }
 
-  iter = c_avl_get_iterator(metrics_tree);
-  while (c_avl_iterator_next(iter, (void *)&name, (void *)&metric) == 0) {
+  /* Backwards, see statsd_map_remove(). */
+  for (size_t i = metrics.entries_num; i > 0; i--) {
+    statsd_metric_t *metric = STATSD_MAP_ENTRY(&metrics, i - 1);
+
     if ((metric->updates_num == 0) &&
-        ((conf_delete_counters && (metric->type == STATSD_COUNTER)) ||
-         (conf_delete_timers && (metric->type == STATSD_TIMER)) ||
-         (conf_delete_gauges && (metric->type == STATSD_GAUGE)) ||
-         (conf_delete_sets && (metric->type == STATSD_SET)))) {
-      DEBUG("statsd plugin: Deleting metric \"%s\".", name);
-      strarray_add(&to_be_deleted, &to_be_deleted_num, name);
+        ((conf_delete_counters && (metric->key.type == STATSD_COUNTER)) ||
+         (conf_delete_timers && (metric->key.type == STATSD_TIMER)) ||
+         (conf_delete_gauges && (metric->key.type == STATSD_GAUGE)) ||
+         (conf_delete_sets && (metric->key.type == STATSD_SET)))) {
+      DEBUG("statsd plugin: Deleting metric \"%s\".", metric->key.name);
+      statsd_metric_free(metric);
+      statsd_map_remove(&metrics, i - 1);
       continue;
     }
 
-    /* Names have a prefix, e.g. "c:", which determines the (statsd) type.
-     * Remove this here. */
-    statsd_metric_submit_unsafe(name + 2, metric);
+    statsd_metric_submit_unsafe(metric->key.name, metric);
 
     /* Reset the metric. */
     metric->updates_num = 0;
-    if (metric->type == STATSD_SET)
+    if (metric->key.type == STATSD_SET)
       statsd_metric_clear_set_unsafe(metric);
   }
-  c_avl_iterator_destroy(iter);
 
-  for (size_t i = 0; i < to_be_deleted_num; i++) {
-    int status;
-
-    status = c_avl_remove(metrics_tree, to_be_deleted[i], (void *)&name,
-                          (void *)&metric);
-    if (status != 0) {
-      ERROR("stats plugin: c_avl_remove (\"%s\") failed with status %i.",
-            to_be_deleted[i], status);
-      continue;
-    }
-
-    sfree(name);
-    statsd_metric_free(metric);
-  }
+  statsd_map_compact(&metrics);
 
   pthread_mutex_unlock(&metrics_lock);
 
-  strarray_free(to_be_deleted, to_be_deleted_num);
-
   return 0;
 } /* }}} int statsd_read */
 
 static int statsd_shutdown(void) /* {{{ */
 {
-  void *key;
-  void *value;
-
-  if (network_thread_running) {
-    network_thread_shutdown = true;
-    pthread_kill(network_thread, SIGTERM);
-    pthread_join(network_thread, /* retval = */ NULL);
+  network_thread_shutdown = true;
+  for (size_t i = 0; i < receivers_num; i++) {
+    statsd_receiver_t *r = receivers + i;
+
+    if (r->thread_running) {
+      pthread_kill(r->thread, SIGTERM);
+      pthread_join(r->thread, /* retval = */ NULL);
+      r->thread_running = false;
+    }
   }
-  network_thread_running = false;
 
   pthread_mutex_lock(&metrics_lock);
 
-  while (c_avl_pick(metrics_tree, &key, &value) == 0) {
-    sfree(key);
-    statsd_metric_free(value);
+  for (size_t i = 0; i < receivers_num; i++) {
+    statsd_receiver_t *r = receivers + i;
+
+    for (size_t j = 0; j < r->deltas.entries_num; j++)
+      statsd_delta_free(STATSD_MAP_ENTRY(&r->deltas, j));
+    statsd_map_destroy(&r->deltas);
+    pthread_mutex_destroy(&r->lock);
   }
-  c_avl_destroy(metrics_tree);
-  metrics_tree = NULL;
+  sfree(receivers);
+  receivers_num = 0;
+
+  for (size_t i = 0; i < metrics.entries_num; i++)
+    statsd_metric_free(STATSD_MAP_ENTRY(&metrics, i));
+  statsd_map_destroy(&metrics);
 
   sfree(conf_node);
   sfree(conf_service);
@@ -39,6 +39,7 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/procfs/procfs.h"
 
 #if HAVE_SYS_SWAP_H
 #include <sys/swap.h>
@@ -78,6 +79,9 @@
 static derive_t pagesize;
 static bool report_bytes;
 static bool report_by_device;
+static cu_procfs_t *proc_swaps;
+static cu_procfs_t *proc_meminfo;
+static cu_procfs_t *proc_vmstat;
 /* #endif KERNEL_LINUX */
 
 #elif HAVE_SWAPCTL && (HAVE_SWAPCTL_TWO_ARGS || HAVE_SWAPCTL_THREE_ARGS)
@@ -234,16 +238,20 @@ swap_submit_derive(char const *type_instance, /* {{{ */
 #if KERNEL_LINUX
 static int swap_read_separate(void) /* {{{ */
 {
-  FILE *fh;
-  char buffer[1024];
+  if ((proc_swaps == NULL) &&
+      ((proc_swaps = cu_procfs_open("/proc/swaps")) == NULL)) {
+    WARNING("swap plugin: open (/proc/swaps) failed: %s", STRERRNO);
+    return -1;
+  }
 
-  fh = fopen("/proc/swaps", "r");
-  if (fh == NULL) {
-    WARNING("swap plugin: fopen (/proc/swaps) failed: %s", STRERRNO);
+  char *cursor = cu_procfs_read(proc_swaps, NULL);
+  if (cursor == NULL) {
+    WARNING("swap plugin: reading /proc/swaps failed: %s", STRERRNO);
     return -1;
   }
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
+  char *buffer;
+  while ((buffer = cu_procfs_line(&cursor)) != NULL) {
     char *fields[8];
     int numfields;
     char *endptr;
@@ -277,44 +285,32 @@ static int swap_read_separate(void) /* {{{ */
     swap_submit_usage(path, used * 1024.0, (total - used) * 1024.0, NULL, NAN);
   }
 
-  fclose(fh);
-
   return 0;
 } /* }}} int swap_read_separate */
 
 static int swap_read_combined(void) /* {{{ */
 {
-  FILE *fh;
-  char buffer[1024];
-
-  gauge_t swap_used = NAN;
-  gauge_t swap_cached = NAN;
-  gauge_t swap_free = NAN;
-  gauge_t swap_total = NAN;
-
-  fh = fopen("/proc/meminfo", "r");
-  if (fh == NULL) {
-    WARNING("swap plugin: fopen (/proc/meminfo) failed: %s", STRERRNO);
+  cu_procfs_key_t keys[] = {
+      {.key = "SwapTotal:"},
+      {.key = "SwapFree:"},
+      {.key = "SwapCached:"},
+  };
+
+  if ((proc_meminfo == NULL) &&
+      ((proc_meminfo = cu_procfs_open("/proc/meminfo")) == NULL)) {
+    WARNING("swap plugin: open (/proc/meminfo) failed: %s", STRERRNO);
     return -1;
   }
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
-    char *fields[8];
-    int numfields;
-
-    numfields = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
-    if (numfields < 2)
-      continue;
-
-    if (strcasecmp(fields[0], "SwapTotal:") == 0)
-      strtogauge(fields[1], &swap_total);
-    else if (strcasecmp(fields[0], "SwapFree:") == 0)
-      strtogauge(fields[1], &swap_free);
-    else if (strcasecmp(fields[0], "SwapCached:") == 0)
-      strtogauge(fields[1], &swap_cached);
+  if (cu_procfs_read_keys(proc_meminfo, keys, STATIC_ARRAY_SIZE(keys)) < 0) {
+    WARNING("swap plugin: reading /proc/meminfo failed: %s", STRERRNO);
+    return -1;
   }
 
-  fclose(fh);
+  gauge_t swap_used = NAN;
+  gauge_t swap_total = keys[0].found ? (gauge_t)keys[0].value : NAN;
+  gauge_t swap_free = keys[1].found ? (gauge_t)keys[1].value : NAN;
+  gauge_t swap_cached = keys[2].found ? (gauge_t)keys[2].value : NAN;
 
   if (isnan(swap_total) || isnan(swap_free))
     return ENOENT;
@@ -337,39 +333,28 @@ static int swap_read_combined(void) /* {{{ */
 
 static int swap_read_io(void) /* {{{ */
 {
-  char buffer[1024];
-
-  uint8_t have_data = 0;
-  derive_t swap_in = 0;
-  derive_t swap_out = 0;
-
-  FILE *fh = fopen("/proc/vmstat", "r");
-  if (fh == NULL) {
-    WARNING("swap: fopen(/proc/vmstat): %s", STRERRNO);
+  cu_procfs_key_t keys[] = {
+      {.key = "pswpin"},
+      {.key = "pswpout"},
+  };
+
+  if ((proc_vmstat == NULL) &&
+      ((proc_vmstat = cu_procfs_open("/proc/vmstat")) == NULL)) {
+    WARNING("swap: open(/proc/vmstat): %s", STRERRNO);
     return -1;
   }
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
-    char *fields[8];
-    int numfields = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
-
-    if (numfields != 2)
-      continue;
-
-    if (strcasecmp("pswpin", fields[0]) == 0) {
-      strtoderive(fields[1], &swap_in);
-      have_data |= 0x01;
-    } else if (strcasecmp("pswpout", fields[0]) == 0) {
-      strtoderive(fields[1], &swap_out);
-      have_data |= 0x02;
-    }
-  } /* while (fgets) */
-
-  fclose(fh);
+  if (cu_procfs_read_keys(proc_vmstat, keys, STATIC_ARRAY_SIZE(keys)) < 0) {
+    WARNING("swap: reading /proc/vmstat failed: %s", STRERRNO);
+    return -1;
+  }
 
-  if (have_data != 0x03)
+  if (!keys[0].found || !keys[1].found)
     return ENOENT;
 
+  derive_t swap_in = (derive_t)keys[0].value;
+  derive_t swap_out = (derive_t)keys[1].value;
+
   if (report_bytes) {
     swap_in = swap_in * pagesize;
     swap_out = swap_out * pagesize;
@@ -771,8 +756,24 @@ static int swap_read(void) /* {{{ */
 } /* }}} int swap_read */
 #endif /* HAVE_PERFSTAT */
 
+#if KERNEL_LINUX
+static int swap_shutdown(void) /* {{{ */
+{
+  cu_procfs_close(proc_swaps);
+  proc_swaps = NULL;
+  cu_procfs_close(proc_meminfo);
+  proc_meminfo = NULL;
+  cu_procfs_close(proc_vmstat);
+  proc_vmstat = NULL;
+  return 0;
+} /* }}} int swap_shutdown */
+#endif
+
 void module_register(void) {
   plugin_register_complex_config("swap", swap_config);
   plugin_register_init("swap", swap_init);
   plugin_register_read("swap", swap_read);
+#if KERNEL_LINUX
+  plugin_register_shutdown("swap", swap_shutdown);
+#endif
 } /* void module_register */
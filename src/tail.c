@@ -289,6 +289,13 @@ static int ctail_config(oconfig_item_t *ci) {
   return 0;
 } /* int ctail_config */
 
+/* Called when the configuration is reloaded: the files are configured again
+ * by "ctail_config". */
+static int ctail_reconfigure(void) {
+  plugin_unregister_read_plugin("tail");
+  return 0;
+} /* int ctail_reconfigure */
+
 static int ctail_read(user_data_t *ud) {
   int status;
 
@@ -303,4 +310,5 @@ static int ctail_read(user_data_t *ud) {
 
 void module_register(void) {
   plugin_register_complex_config("tail", ctail_config);
+  plugin_register_reconfigure("tail", ctail_reconfigure);
 } /* void module_register */
@@ -28,6 +28,7 @@
 
 #include "filter_chain.h"
 #include "utils/common/common.h"
+#include "utils/memo/memo.h"
 #include "utils_subst.h"
 
 #include <regex.h>
@@ -59,9 +60,19 @@ struct tr_data_s {
   /* tr_action_t *type; */
   tr_action_t *type_instance;
   tr_meta_data_action_t *meta;
+
+  /* Results of the actions above, keyed by the original field. Most series
+   * are rewritten the same way every interval, so this saves running the
+   * regular expressions again. NULL if "CacheSize" is zero. */
+  c_memo_t *host_memo;
+  c_memo_t *plugin_memo;
+  c_memo_t *plugin_instance_memo;
+  c_memo_t *type_instance_memo;
 };
 typedef struct tr_data_s tr_data_t;
 
+#define TR_DEFAULT_CACHE_SIZE 1024
+
 static char *tr_strdup(const char *orig) /* {{{ */
 {
   size_t sz;
@@ -261,8 +272,8 @@ static int tr_config_add_meta_action(tr_meta_data_action_t **dest, /* {{{ */
 } /* }}} int tr_config_add_meta_action */
 
 static int tr_action_invoke(tr_action_t *act_head, /* {{{ */
-                            char *buffer_in, size_t buffer_in_size,
-                            bool may_be_empty) {
+                            c_memo_t *memo, char *buffer_in,
+                            size_t buffer_in_size, bool may_be_empty) {
   int status;
   char buffer[DATA_MAX_NAME_LEN];
   regmatch_t matches[8] = {[0] = {0}};
@@ -272,6 +283,10 @@ static int tr_action_invoke(tr_action_t *act_head, /* {{{ */
 
   sstrncpy(buffer, buffer_in, sizeof(buffer));
 
+  if ((memo != NULL) &&
+      (c_memo_get(memo, buffer, buffer_in, buffer_in_size) == 0))
+    return 0;
+
   DEBUG("target_replace plugin: tr_action_invoke: <- buffer = %s;", buffer);
 
   for (tr_action_t *act = act_head; act != NULL; act = act->next) {
@@ -309,10 +324,14 @@ static int tr_action_invoke(tr_action_t *act_head, /* {{{ */
   if ((may_be_empty == false) && (buffer[0] == 0)) {
     WARNING("Target `replace': Replacement resulted in an empty string, "
             "which is not allowed for this buffer (`host' or `plugin').");
+    if (memo != NULL)
+      c_memo_put(memo, buffer_in, buffer_in);
     return 0;
   }
 
   DEBUG("target_replace plugin: tr_action_invoke: -> buffer = %s;", buffer);
+  if (memo != NULL)
+    c_memo_put(memo, buffer_in, buffer);
   sstrncpy(buffer_in, buffer, buffer_in_size);
 
   return 0;
@@ -440,6 +459,10 @@ static int tr_destroy(void **user_data) /* {{{ */
   /* tr_action_destroy (data->type); */
   tr_action_destroy(data->type_instance);
   tr_meta_data_action_destroy(data->meta);
+  c_memo_destroy(data->host_memo);
+  c_memo_destroy(data->plugin_memo);
+  c_memo_destroy(data->plugin_instance_memo);
+  c_memo_destroy(data->type_instance_memo);
   sfree(data);
 
   return 0;
@@ -463,6 +486,8 @@ static int tr_create(const oconfig_item_t *ci, void **user_data) /* {{{ */
   data->type_instance = NULL;
   data->meta = NULL;
 
+  int cache_size = TR_DEFAULT_CACHE_SIZE;
+
   status = 0;
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
@@ -491,7 +516,13 @@ static int tr_create(const oconfig_item_t *ci, void **user_data) /* {{{ */
     else if (strcasecmp("DeleteMetaData", child->key) == 0)
       status = tr_config_add_meta_action(&data->meta, child,
                                          /* should delete = */ true);
-    else {
+    else if (strcasecmp("CacheSize", child->key) == 0) {
+      status = cf_util_get_int(child, &cache_size);
+      if ((status == 0) && (cache_size < 0)) {
+        ERROR("Target `replace': `CacheSize' must not be negative.");
+        status = -1;
+      }
+    } else {
       ERROR("Target `replace': The `%s' configuration option is not understood "
             "and will be ignored.",
             child->key);
@@ -516,6 +547,20 @@ static int tr_create(const oconfig_item_t *ci, void **user_data) /* {{{ */
     break;
   }
 
+#define CREATE_MEMO(f)                                                         \
+  if ((status == 0) && (cache_size > 0) && (data->f != NULL)) {                \
+    data->f##_memo = c_memo_create((size_t)cache_size);                        \
+    if (data->f##_memo == NULL) {                                              \
+      ERROR("Target `replace': c_memo_create failed.");                        \
+      status = -ENOMEM;                                                        \
+    }                                                                          \
+  }
+  CREATE_MEMO(host);
+  CREATE_MEMO(plugin);
+  CREATE_MEMO(plugin_instance);
+  CREATE_MEMO(type_instance);
+#undef CREATE_MEMO
+
   if (status != 0) {
     tr_destroy((void *)&data);
     return status;
@@ -545,7 +590,7 @@ static int tr_invoke(const data_set_t *ds, value_list_t *vl, /* {{{ */
 
 #define HANDLE_FIELD(f, e)                                                     \
   if (data->f != NULL)                                                         \
-  tr_action_invoke(data->f, vl->f, sizeof(vl->f), e)
+  tr_action_invoke(data->f, data->f##_memo, vl->f, sizeof(vl->f), e)
   HANDLE_FIELD(host, false);
   HANDLE_FIELD(plugin, false);
   HANDLE_FIELD(plugin_instance, true);
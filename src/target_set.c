@@ -182,7 +182,8 @@ static void ts_subst(char *dest, size_t size, const char *string, /* {{{ */
   REPLACE_FIELD("%{type}", vl->type);
   REPLACE_FIELD("%{type_instance}", vl->type_instance);
 
-  if (vl->meta != NULL) {
+  /* Only walk the meta data if the template refers to it. */
+  if ((vl->meta != NULL) && (strstr(dest, "%{meta:") != NULL)) {
     char **meta_toc = NULL;
     int status = meta_data_toc(vl->meta, &meta_toc);
     if (status <= 0)
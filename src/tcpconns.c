@@ -80,6 +80,9 @@
 #if HAVE_LINUX_INET_DIAG_H
 #include <linux/inet_diag.h>
 #endif
+#if HAVE_STRUCT_LINUX_INET_DIAG_REQ_V2
+#include <linux/sock_diag.h>
+#endif
 #include <arpa/inet.h>
 /* #endif KERNEL_LINUX */
 
@@ -149,7 +152,13 @@
 #endif /* KERNEL_AIX */
 
 #if KERNEL_LINUX
-#if HAVE_STRUCT_LINUX_INET_DIAG_REQ
+#if HAVE_STRUCT_LINUX_INET_DIAG_REQ_V2
+struct nlreq {
+  struct nlmsghdr nlh;
+  struct inet_diag_req_v2 r;
+  struct nlattr bytecode;
+};
+#elif HAVE_STRUCT_LINUX_INET_DIAG_REQ
 struct nlreq {
   struct nlmsghdr nlh;
   struct inet_diag_req r;
@@ -264,6 +273,9 @@ static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 static int port_collect_listening;
 static int port_collect_total;
 static port_entry_t *port_list_head;
+/* One bit per port in port_list_head, so that connections on other ports are
+ * skipped without walking the list. */
+static uint8_t port_list_map[(UINT16_MAX + 1) / 8];
 static uint32_t count_total[TCP_STATE_MAX + 1];
 
 #if KERNEL_LINUX
@@ -346,6 +358,9 @@ static void conn_submit_all(void) {
 static port_entry_t *conn_get_port_entry(uint16_t port, int create) {
   port_entry_t *ret;
 
+  if ((create == 0) && ((port_list_map[port / 8] & (1 << (port % 8))) == 0))
+    return NULL;
+
   ret = port_list_head;
   while (ret != NULL) {
     if (ret->port == port)
@@ -361,6 +376,7 @@ static port_entry_t *conn_get_port_entry(uint16_t port, int create) {
     ret->port = port;
     ret->next = port_list_head;
     port_list_head = ret;
+    port_list_map[port / 8] |= 1 << (port % 8);
   }
 
   return ret;
@@ -389,6 +405,7 @@ static void conn_reset_port_entry(void) {
         port_list_head = next;
       else
         prev->next = next;
+      port_list_map[pe->port / 8] &= ~(1 << (pe->port % 8));
 
       sfree(pe);
       pe = next;
@@ -444,67 +461,26 @@ static int conn_handle_ports(uint16_t port_local, uint16_t port_remote,
 } /* int conn_handle_ports */
 
 #if KERNEL_LINUX
-/* Returns zero on success, less than zero on socket error and greater than
- * zero on other errors. */
-static int conn_read_netlink(void) {
 #if HAVE_STRUCT_LINUX_INET_DIAG_REQ
-  int fd;
+/* Receives the reply to the request with sequence_number and passes each
+ * socket to conn_handle_ports(). Returns zero on success, less than zero on
+ * socket error and greater than zero on other errors. */
+static int conn_recv_netlink(int fd) {
   struct inet_diag_msg *r;
-  char buf[8192];
-
-  /* If this fails, it's likely a permission problem. We'll fall back to
-   * reading this information from files below. */
-  fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_INET_DIAG);
-  if (fd < 0) {
-    ERROR("tcpconns plugin: conn_read_netlink: socket(AF_NETLINK, SOCK_RAW, "
-          "NETLINK_INET_DIAG) failed: %s",
-          STRERRNO);
-    return -1;
-  }
+  /* Dumps are sent in messages of up to 32 KiB if the buffer supplied to
+   * recvmsg(2) is large enough. */
+  char buf[32768];
 
   struct sockaddr_nl nladdr = {.nl_family = AF_NETLINK};
-
-  struct nlreq req = {
-      .nlh.nlmsg_len = sizeof(req),
-      .nlh.nlmsg_type = TCPDIAG_GETSOCK,
-      /* NLM_F_ROOT: return the complete table instead of a single entry.
-       * NLM_F_MATCH: return all entries matching criteria (not implemented)
-       * NLM_F_REQUEST: must be set on all request messages */
-      .nlh.nlmsg_flags = NLM_F_ROOT | NLM_F_MATCH | NLM_F_REQUEST,
-      .nlh.nlmsg_pid = 0,
-      /* The sequence_number is used to track our messages. Since netlink is not
-       * reliable, we don't want to end up with a corrupt or incomplete old
-       * message in case the system is/was out of memory. */
-      .nlh.nlmsg_seq = ++sequence_number,
-      .r.idiag_family = AF_INET,
-      .r.idiag_states = 0xfff,
-      .r.idiag_ext = 0};
-
-  struct iovec iov = {.iov_base = &req, .iov_len = sizeof(req)};
-
-  struct msghdr msg = {.msg_name = (void *)&nladdr,
-                       .msg_namelen = sizeof(nladdr),
-                       .msg_iov = &iov,
-                       .msg_iovlen = 1};
-
-  if (sendmsg(fd, &msg, 0) < 0) {
-    ERROR("tcpconns plugin: conn_read_netlink: sendmsg(2) failed: %s",
-          STRERRNO);
-    close(fd);
-    return -1;
-  }
-
-  iov.iov_base = buf;
-  iov.iov_len = sizeof(buf);
+  struct iovec iov = {.iov_base = buf, .iov_len = sizeof(buf)};
 
   while (1) {
     struct nlmsghdr *h;
 
-    memset(&msg, 0, sizeof(msg));
-    msg.msg_name = (void *)&nladdr;
-    msg.msg_namelen = sizeof(nladdr);
-    msg.msg_iov = &iov;
-    msg.msg_iovlen = 1;
+    struct msghdr msg = {.msg_name = (void *)&nladdr,
+                         .msg_namelen = sizeof(nladdr),
+                         .msg_iov = &iov,
+                         .msg_iovlen = 1};
 
     ssize_t status = recvmsg(fd, (void *)&msg, /* flags = */ 0);
     if (status < 0) {
@@ -513,13 +489,14 @@ static int conn_read_netlink(void) {
 
       ERROR("tcpconns plugin: conn_read_netlink: recvmsg(2) failed: %s",
             STRERRNO);
-      close(fd);
       return -1;
     } else if (status == 0) {
-      close(fd);
       DEBUG("tcpconns plugin: conn_read_netlink: Unexpected zero-sized "
             "reply from netlink socket.");
       return 0;
+    } else if (msg.msg_flags & MSG_TRUNC) {
+      ERROR("tcpconns plugin: conn_read_netlink: Netlink message truncated.");
+      return -1;
     }
 
     h = (struct nlmsghdr *)buf;
@@ -530,7 +507,6 @@ static int conn_read_netlink(void) {
       }
 
       if (h->nlmsg_type == NLMSG_DONE) {
-        close(fd);
         return 0;
       } else if (h->nlmsg_type == NLMSG_ERROR) {
         struct nlmsgerr *msg_error;
@@ -539,7 +515,6 @@ static int conn_read_netlink(void) {
         WARNING("tcpconns plugin: conn_read_netlink: Received error %i.",
                 msg_error->error);
 
-        close(fd);
         return 1;
       }
 
@@ -555,6 +530,232 @@ static int conn_read_netlink(void) {
 
   /* Not reached because the while() loop above handles the exit condition. */
   return 0;
+} /* int conn_recv_netlink */
+#endif /* HAVE_STRUCT_LINUX_INET_DIAG_REQ */
+
+#if HAVE_STRUCT_LINUX_INET_DIAG_REQ_V2
+#define CONN_STATES_ALL 0xfff
+#define CONN_STATES_LISTEN (1 << TCP_STATE_LISTEN)
+
+/* Appends "port >= p && port <= p" to the filter, using inet_diag's "ports
+ * are at least / at most" comparisons, which all kernels support. If the
+ * comparison fails, the code continues right after the following jump. */
+static void conn_filter_add_port(struct inet_diag_bc_op *op, /* {{{ */
+                                 uint8_t code_ge, uint8_t code_le,
+                                 uint16_t port) {
+  op[0] = (struct inet_diag_bc_op){.code = code_ge, .yes = 8, .no = 20};
+  op[1] = (struct inet_diag_bc_op){.no = port};
+  op[2] = (struct inet_diag_bc_op){.code = code_le, .yes = 8, .no = 12};
+  op[3] = (struct inet_diag_bc_op){.no = port};
+} /* }}} void conn_filter_add_port */
+
+/* Builds an inet_diag filter which matches the sockets with a local or
+ * remote port that is going to be reported. The port comparisons are
+ * "or"ed: each match jumps past the end of the filter, which means "accept",
+ * each mismatch tries the next port. A mismatch of the last port jumps four
+ * bytes past the end, which means "reject". Returns the size of the filter in
+ * bytes, zero if no port needs to be reported and SIZE_MAX if all sockets
+ * are needed. */
+static size_t conn_filter_build(struct inet_diag_bc_op **ret) /* {{{ */
+{
+  /* The filter is sent as a netlink attribute, which is limited to 64 KiB. */
+  size_t max_ports = (UINT16_MAX - sizeof(struct nlattr) + 4) / 20;
+  struct inet_diag_bc_op *ops;
+  size_t ports_num = 0;
+  size_t len;
+
+  for (port_entry_t *pe = port_list_head; pe != NULL; pe = pe->next) {
+    if (pe->flags & (PORT_COLLECT_LOCAL | PORT_IS_LISTENING))
+      ports_num++;
+    if (pe->flags & PORT_COLLECT_REMOTE)
+      ports_num++;
+  }
+
+  if (ports_num == 0)
+    return 0;
+  if (ports_num > max_ports)
+    return SIZE_MAX;
+
+  /* 16 bytes for each port, 4 bytes for each jump between ports. */
+  len = 20 * ports_num - 4;
+  ops = calloc(1, len);
+  if (ops == NULL)
+    return SIZE_MAX;
+
+  size_t pos = 0;
+  for (port_entry_t *pe = port_list_head; pe != NULL; pe = pe->next) {
+    for (int remote = 0; remote < 2; remote++) {
+      if (!remote && !(pe->flags & (PORT_COLLECT_LOCAL | PORT_IS_LISTENING)))
+        continue;
+      if (remote && !(pe->flags & PORT_COLLECT_REMOTE))
+        continue;
+
+      if (pos > 0) {
+        ops[pos / 4] = (struct inet_diag_bc_op){
+            .code = INET_DIAG_BC_JMP, .yes = 4, .no = len - pos};
+        pos += 4;
+      }
+
+      if (remote)
+        conn_filter_add_port(ops + pos / 4, INET_DIAG_BC_D_GE,
+                             INET_DIAG_BC_D_LE, pe->port);
+      else
+        conn_filter_add_port(ops + pos / 4, INET_DIAG_BC_S_GE,
+                             INET_DIAG_BC_S_LE, pe->port);
+      pos += 16;
+    }
+  }
+  assert(pos == len);
+
+  *ret = ops;
+  return len;
+} /* }}} size_t conn_filter_build */
+
+/* Requests the TCP sockets of "family" in "states" which match the filter
+ * and handles the reply. */
+static int conn_dump_netlink(int fd, uint8_t family, /* {{{ */
+                             uint32_t states,
+                             struct inet_diag_bc_op const *filter,
+                             size_t filter_len) {
+  struct sockaddr_nl nladdr = {.nl_family = AF_NETLINK};
+
+  struct nlreq req = {
+      .nlh.nlmsg_len = sizeof(req) + filter_len,
+      .nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY,
+      /* NLM_F_DUMP: return all entries matching the request.
+       * NLM_F_REQUEST: must be set on all request messages */
+      .nlh.nlmsg_flags = NLM_F_DUMP | NLM_F_REQUEST,
+      .nlh.nlmsg_pid = 0,
+      /* The sequence_number is used to track our messages. Since netlink is not
+       * reliable, we don't want to end up with a corrupt or incomplete old
+       * message in case the system is/was out of memory. */
+      .nlh.nlmsg_seq = ++sequence_number,
+      .r.sdiag_family = family,
+      .r.sdiag_protocol = IPPROTO_TCP,
+      .r.idiag_states = states,
+      .r.idiag_ext = 0,
+      .bytecode.nla_type = INET_DIAG_REQ_BYTECODE,
+      .bytecode.nla_len = sizeof(req.bytecode) + filter_len};
+
+  struct iovec iov[] = {
+      {.iov_base = &req, .iov_len = sizeof(req)},
+      {.iov_base = (void *)filter, .iov_len = filter_len},
+  };
+
+  /* Without a filter, the attribute is left out. */
+  if (filter_len == 0) {
+    req.nlh.nlmsg_len = offsetof(struct nlreq, bytecode);
+    iov[0].iov_len = req.nlh.nlmsg_len;
+  }
+
+  struct msghdr msg = {.msg_name = (void *)&nladdr,
+                       .msg_namelen = sizeof(nladdr),
+                       .msg_iov = iov,
+                       .msg_iovlen = (filter_len != 0) ? 2 : 1};
+
+  if (sendmsg(fd, &msg, 0) < 0) {
+    ERROR("tcpconns plugin: conn_read_netlink: sendmsg(2) failed: %s",
+          STRERRNO);
+    return -1;
+  }
+
+  return conn_recv_netlink(fd);
+} /* }}} int conn_dump_netlink */
+#endif /* HAVE_STRUCT_LINUX_INET_DIAG_REQ_V2 */
+
+/* Returns zero on success, less than zero on socket error and greater than
+ * zero on other errors. */
+static int conn_read_netlink(void) {
+#if HAVE_STRUCT_LINUX_INET_DIAG_REQ_V2
+  static uint8_t const families[] = {AF_INET, AF_INET6};
+  struct inet_diag_bc_op *filter = NULL;
+  size_t filter_len;
+  uint32_t states = CONN_STATES_ALL;
+  int fd;
+  int status = 0;
+
+  /* If this fails, it's likely a permission problem. We'll fall back to
+   * reading this information from files below. */
+  fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_INET_DIAG);
+  if (fd < 0) {
+    ERROR("tcpconns plugin: conn_read_netlink: socket(AF_NETLINK, SOCK_RAW, "
+          "NETLINK_INET_DIAG) failed: %s",
+          STRERRNO);
+    return -1;
+  }
+
+  /* With "AllPortsSummary" every socket is counted. Otherwise the kernel only
+   * returns the sockets on reported ports. Listening sockets are fetched first
+   * with "ListeningPorts", because their ports are reported, too. */
+  if (!port_collect_total && port_collect_listening) {
+    for (size_t i = 0; (status == 0) && (i < STATIC_ARRAY_SIZE(families)); i++)
+      status = conn_dump_netlink(fd, families[i], CONN_STATES_LISTEN,
+                                 /* filter = */ NULL, /* filter_len = */ 0);
+    states &= ~CONN_STATES_LISTEN;
+  }
+
+  filter_len = port_collect_total ? SIZE_MAX : conn_filter_build(&filter);
+  if (filter_len == SIZE_MAX)
+    filter_len = 0;
+  else if (filter_len == 0)
+    states = 0;
+
+  for (size_t i = 0;
+       (status == 0) && (states != 0) && (i < STATIC_ARRAY_SIZE(families)); i++)
+    status = conn_dump_netlink(fd, families[i], states, filter, filter_len);
+
+  sfree(filter);
+  close(fd);
+  return status;
+#elif HAVE_STRUCT_LINUX_INET_DIAG_REQ
+  int fd;
+  int status;
+
+  /* If this fails, it's likely a permission problem. We'll fall back to
+   * reading this information from files below. */
+  fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_INET_DIAG);
+  if (fd < 0) {
+    ERROR("tcpconns plugin: conn_read_netlink: socket(AF_NETLINK, SOCK_RAW, "
+          "NETLINK_INET_DIAG) failed: %s",
+          STRERRNO);
+    return -1;
+  }
+
+  struct sockaddr_nl nladdr = {.nl_family = AF_NETLINK};
+
+  struct nlreq req = {
+      .nlh.nlmsg_len = sizeof(req),
+      .nlh.nlmsg_type = TCPDIAG_GETSOCK,
+      /* NLM_F_ROOT: return the complete table instead of a single entry.
+       * NLM_F_MATCH: return all entries matching criteria (not implemented)
+       * NLM_F_REQUEST: must be set on all request messages */
+      .nlh.nlmsg_flags = NLM_F_ROOT | NLM_F_MATCH | NLM_F_REQUEST,
+      .nlh.nlmsg_pid = 0,
+      /* The sequence_number is used to track our messages. Since netlink is not
+       * reliable, we don't want to end up with a corrupt or incomplete old
+       * message in case the system is/was out of memory. */
+      .nlh.nlmsg_seq = ++sequence_number,
+      .r.idiag_family = AF_INET,
+      .r.idiag_states = 0xfff,
+      .r.idiag_ext = 0};
+
+  struct iovec iov = {.iov_base = &req, .iov_len = sizeof(req)};
+
+  struct msghdr msg = {.msg_name = (void *)&nladdr,
+                       .msg_namelen = sizeof(nladdr),
+                       .msg_iov = &iov,
+                       .msg_iovlen = 1};
+
+  if (sendmsg(fd, &msg, 0) < 0) {
+    ERROR("tcpconns plugin: conn_read_netlink: sendmsg(2) failed: %s",
+          STRERRNO);
+    close(fd);
+    return -1;
+  }
+
+  status = conn_recv_netlink(fd);
+  close(fd);
+  return status;
 #else
   return 1;
 #endif /* HAVE_STRUCT_LINUX_INET_DIAG_REQ */
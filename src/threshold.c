@@ -92,6 +92,9 @@ static int ut_threshold_add(const threshold_t *th) { /* {{{ */
     sfree(name_copy);
   }
 
+  if (status == 0)
+    __atomic_add_fetch(&threshold_generation, 1, __ATOMIC_RELEASE);
+
   pthread_mutex_unlock(&threshold_lock);
 
   if (status != 0) {
@@ -620,11 +623,7 @@ static int ut_check_threshold(const data_set_t *ds, const value_list_t *vl,
   if (threshold_tree == NULL)
     return 0;
 
-  /* Is this lock really necessary? So far, thresholds are only inserted at
-   * startup. -octo */
-  pthread_mutex_lock(&threshold_lock);
-  th = threshold_search(vl);
-  pthread_mutex_unlock(&threshold_lock);
+  th = threshold_search_cached(vl);
   if (th == NULL)
     return 0;
 
@@ -682,7 +681,7 @@ static int ut_missing(const value_list_t *vl,
   if (threshold_tree == NULL)
     return 0;
 
-  th = threshold_search(vl);
+  th = threshold_search_cached(vl);
   /* dispatch notifications for "interesting" values only */
   if ((th == NULL) || ((th->flags & UT_FLAG_INTERESTING) == 0))
     return 0;
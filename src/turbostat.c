@@ -46,9 +46,35 @@
 #ifdef HAVE_SYS_CAPABILITY_H
 #include <sys/capability.h>
 #endif /* HAVE_SYS_CAPABILITY_H */
+#include <sys/ioctl.h>
 
 #define PLUGIN_NAME "turbostat"
 
+/*
+ * The msr-safe kernel module (https://github.com/LLNL/msr-safe) can read the
+ * MSRs of any number of CPUs with a single ioctl on its batch device. These
+ * definitions match the ones of its msr_safe.h.
+ */
+#define MSR_BATCH_DEVICE "/dev/cpu/msr_batch"
+
+struct msr_batch_op {
+  uint16_t cpu;     /* CPU to execute the rdmsr instruction on */
+  uint16_t isrdmsr; /* 0 = wrmsr, non-zero = rdmsr */
+  int32_t err;      /* set if the operation failed */
+  uint32_t msr;     /* MSR address */
+  uint64_t msrdata; /* result of the operation */
+  uint64_t wmask;   /* write mask applied to wrmsr */
+};
+
+struct msr_batch_array {
+  uint32_t numops;
+  struct msr_batch_op *ops;
+};
+
+#ifndef X86_IOC_MSR_BATCH
+#define X86_IOC_MSR_BATCH _IOWR('c', 0xA2, struct msr_batch_array)
+#endif
+
 typedef enum affinity_policy_enum {
   policy_restore_affinity, /* restore cpu affinity to whatever it was before */
   policy_allcpus_affinity  /* do not restore affinity, set to all cpus */
@@ -80,6 +106,12 @@ static bool aperf_mperf_unstable;
  */
 static bool config_lcn;
 
+/*
+ * If set, the MSRs of each package are read by a thread of its own which is
+ * pinned to that package. Not used with the msr-safe batch device.
+ */
+static bool config_package_threads;
+
 /*
  * Bitmask of the list of core C states supported by the processor.
  * Currently supported C-states (by this plugin): 3, 6, 7
@@ -166,10 +198,38 @@ static double rapl_power_units;
 /* 0x642 MSR_PP1_POLICY */
 #define TJMAX_DEFAULT 100
 
-static cpu_set_t *cpu_present_set, *cpu_affinity_set, *cpu_saved_affinity_set;
+static cpu_set_t *cpu_present_set, *cpu_saved_affinity_set;
 static size_t cpu_present_setsize, cpu_affinity_setsize,
     cpu_saved_affinity_setsize;
 
+/*
+ * Per CPU state for reading MSRs through /dev/cpu/N/msr: the device is opened
+ * on first use and then kept open. "set" only contains this CPU and is used
+ * to migrate there before reading, so reading needs no inter-processor
+ * interrupt.
+ */
+static struct msr_cpu {
+  int fd;
+  cpu_set_t *set;
+} * msr_cpus;
+
+/*
+ * How get_counters() accesses the MSRs: one by one through the msr device
+ * of each CPU, or from the msr-safe batch. The batch is built once by running
+ * get_counters() in the "record" mode, afterwards each read issues the whole
+ * batch and get_counters() takes its results in the same order.
+ */
+static enum {
+  MSR_ACCESS_DIRECT,
+  MSR_ACCESS_BATCH_RECORD,
+  MSR_ACCESS_BATCH_REPLAY,
+} msr_access;
+
+static int msr_batch_fd = -1;
+static struct msr_batch_array msr_batch;
+static size_t msr_batch_size;
+static size_t msr_batch_pos;
+
 static struct thread_data {
   unsigned long long tsc;
   unsigned long long aperf;
@@ -253,6 +313,7 @@ static const char *config_keys[] = {
     "RunningAveragePowerLimit",
     "LogicalCoreNames",
     "RestoreAffinityPolicy",
+    "PackageThreads",
 };
 static const int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
@@ -262,30 +323,11 @@ static const int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 /*
  * Open a MSR device for reading
- * Can change the scheduling affinity of the current process if multiple_read is
- * true
  */
-static int __attribute__((warn_unused_result))
-open_msr(unsigned int cpu, bool multiple_read) {
+static int __attribute__((warn_unused_result)) open_msr(unsigned int cpu) {
   char pathname[32];
   int fd;
 
-  /*
-   * If we need to do multiple read, let's migrate to the CPU
-   * Otherwise, we would lose time calling functions on another CPU
-   *
-   * If we are not yet initialized (cpu_affinity_setsize = 0),
-   * we need to skip this optimisation.
-   */
-  if (multiple_read && cpu_affinity_setsize) {
-    CPU_ZERO_S(cpu_affinity_setsize, cpu_affinity_set);
-    CPU_SET_S(cpu, cpu_affinity_setsize, cpu_affinity_set);
-    if (sched_setaffinity(0, cpu_affinity_setsize, cpu_affinity_set) == -1) {
-      ERROR("turbostat plugin: Could not migrate to CPU %d", cpu);
-      return -1;
-    }
-  }
-
   snprintf(pathname, sizeof(pathname), "/dev/cpu/%d/msr", cpu);
   fd = open(pathname, O_RDONLY);
   if (fd < 0) {
@@ -321,7 +363,7 @@ get_msr(unsigned int cpu, off_t offset, unsigned long long *msr) {
   ssize_t retval;
   int fd;
 
-  fd = open_msr(cpu, 0);
+  fd = open_msr(cpu);
   if (fd < 0)
     return fd;
   retval = read_msr(fd, offset, msr);
@@ -329,6 +371,72 @@ get_msr(unsigned int cpu, off_t offset, unsigned long long *msr) {
   return retval;
 }
 
+/*
+ * Return the (cached) MSR device of a CPU for reading several MSRs
+ * Changes the scheduling affinity of the calling thread to that CPU, otherwise
+ * we would lose time calling functions on another CPU
+ */
+static int __attribute__((warn_unused_result)) get_msr_fd(unsigned int cpu) {
+  struct msr_cpu *m = &msr_cpus[cpu];
+
+  if (sched_setaffinity(0, cpu_affinity_setsize, m->set) == -1) {
+    ERROR("turbostat plugin: Could not migrate to CPU %d", cpu);
+    return -1;
+  }
+
+  if (m->fd < 0)
+    m->fd = open_msr(cpu);
+  return m->fd;
+}
+
+/*
+ * Add a read of an MSR to the msr-safe batch
+ */
+static int __attribute__((warn_unused_result))
+add_batch_msr(unsigned int cpu, off_t offset) {
+  if (msr_batch.numops >= msr_batch_size) {
+    size_t size = (msr_batch_size == 0) ? 64 : 2 * msr_batch_size;
+    struct msr_batch_op *ops = realloc(msr_batch.ops, size * sizeof(*ops));
+    if (ops == NULL) {
+      ERROR("turbostat plugin: realloc failed");
+      return -1;
+    }
+    msr_batch.ops = ops;
+    msr_batch_size = size;
+  }
+
+  msr_batch.ops[msr_batch.numops++] = (struct msr_batch_op){
+      .cpu = (uint16_t)cpu,
+      .isrdmsr = 1,
+      .msr = (uint32_t)offset,
+  };
+  return 0;
+}
+
+/*
+ * Read one MSR of a CPU as selected by msr_access
+ */
+static int __attribute__((warn_unused_result))
+get_counter_msr(unsigned int cpu, int fd, off_t offset,
+                unsigned long long *msr) {
+  switch (msr_access) {
+  case MSR_ACCESS_BATCH_RECORD:
+    *msr = 0;
+    return add_batch_msr(cpu, offset);
+  case MSR_ACCESS_BATCH_REPLAY: {
+    if (msr_batch_pos >= msr_batch.numops)
+      return -1;
+    struct msr_batch_op *op = msr_batch.ops + msr_batch_pos++;
+    if ((op->cpu != cpu) || (op->msr != offset) || (op->err != 0))
+      return -1;
+    *msr = op->msrdata;
+    return 0;
+  }
+  default:
+    return read_msr(fd, offset, msr);
+  }
+}
+
 /********************************
  * Raw data acquisition (1 CPU) *
  ********************************/
@@ -347,16 +455,18 @@ static int __attribute__((warn_unused_result))
 get_counters(struct thread_data *t, struct core_data *c, struct pkg_data *p) {
   unsigned int cpu = t->cpu_id;
   unsigned long long msr;
-  int msr_fd;
+  int msr_fd = -1;
   int retval = 0;
 
-  msr_fd = open_msr(cpu, 1);
-  if (msr_fd < 0)
-    return msr_fd;
+  if (msr_access == MSR_ACCESS_DIRECT) {
+    msr_fd = get_msr_fd(cpu);
+    if (msr_fd < 0)
+      return msr_fd;
+  }
 
 #define READ_MSR(msr, dst)                                                     \
   do {                                                                         \
-    if (read_msr(msr_fd, msr, dst)) {                                          \
+    if (get_counter_msr(cpu, msr_fd, msr, dst)) {                              \
       ERROR("turbostat plugin: Unable to read " #msr);                         \
       retval = -1;                                                             \
       goto out;                                                                \
@@ -434,13 +544,12 @@ get_counters(struct thread_data *t, struct core_data *c, struct pkg_data *p) {
     READ_MSR(MSR_IA32_PACKAGE_THERM_STATUS, &msr);
     p->pkg_temp_c = p->tcc_activation_temp - ((msr >> 16) & 0x7F);
   }
-  if (do_power_fields & TURBO_PLATFORM) {
+  if (do_power_fields & (TURBO_PLATFORM | PSTATES_PLATFORM)) {
     READ_MSR(MSR_IA32_MISC_ENABLE, &msr);
-    p->turbo_enabled = !((msr >> 38) & 0x1);
-  }
-  if (do_power_fields & PSTATES_PLATFORM) {
-    READ_MSR(MSR_IA32_MISC_ENABLE, &msr);
-    p->pstates_enabled = (msr >> 16) & 0x1;
+    if (do_power_fields & TURBO_PLATFORM)
+      p->turbo_enabled = !((msr >> 38) & 0x1);
+    if (do_power_fields & PSTATES_PLATFORM)
+      p->pstates_enabled = (msr >> 16) & 0x1;
   }
   if (do_power_fields & UFS_PLATFORM) {
     READ_MSR(MSR_UNCORE_FREQ_SCALING, &msr);
@@ -448,7 +557,6 @@ get_counters(struct thread_data *t, struct core_data *c, struct pkg_data *p) {
   }
 
 out:
-  close(msr_fd);
   return retval;
 }
 
@@ -708,6 +816,43 @@ static int cpu_is_not_present(unsigned int cpu) {
   return !CPU_ISSET_S(cpu, cpu_present_setsize, cpu_present_set);
 }
 
+/*
+ * Loop on all CPUs of one package in topological order
+ *
+ * Skip non-present cpus
+ * Return the error code at the first error or 0
+ */
+static int __attribute__((warn_unused_result))
+for_package_cpus(unsigned int pkg_no,
+                 int(func)(struct thread_data *, struct core_data *,
+                           struct pkg_data *),
+                 struct thread_data *thread_base, struct core_data *core_base,
+                 struct pkg_data *pkg_base) {
+  int retval;
+
+  for (unsigned int core_no = 0; core_no < topology.num_cores; ++core_no) {
+    for (unsigned int thread_no = 0; thread_no < topology.num_threads;
+         ++thread_no) {
+      struct thread_data *t;
+      struct core_data *c;
+      struct pkg_data *p;
+
+      t = GET_THREAD(thread_base, thread_no, core_no, pkg_no);
+
+      if (cpu_is_not_present(t->cpu_id))
+        continue;
+
+      c = GET_CORE(core_base, core_no, pkg_no);
+      p = GET_PKG(pkg_base, pkg_no);
+
+      retval = func(t, c, p);
+      if (retval)
+        return retval;
+    }
+  }
+  return 0;
+}
+
 /*
  * Loop on all CPUs in topological order
  *
@@ -722,26 +867,10 @@ for_all_cpus(int(func)(struct thread_data *, struct core_data *,
   int retval;
 
   for (unsigned int pkg_no = 0; pkg_no < topology.num_packages; ++pkg_no) {
-    for (unsigned int core_no = 0; core_no < topology.num_cores; ++core_no) {
-      for (unsigned int thread_no = 0; thread_no < topology.num_threads;
-           ++thread_no) {
-        struct thread_data *t;
-        struct core_data *c;
-        struct pkg_data *p;
-
-        t = GET_THREAD(thread_base, thread_no, core_no, pkg_no);
-
-        if (cpu_is_not_present(t->cpu_id))
-          continue;
-
-        c = GET_CORE(core_base, core_no, pkg_no);
-        p = GET_PKG(pkg_base, pkg_no);
-
-        retval = func(t, c, p);
-        if (retval)
-          return retval;
-      }
-    }
+    retval =
+        for_package_cpus(pkg_no, func, thread_base, core_base, pkg_base);
+    if (retval)
+      return retval;
   }
   return 0;
 }
@@ -1265,9 +1394,6 @@ static int __attribute__((warn_unused_result)) topology_probe(void) {
   }
 
   ret = allocate_cpu_set(&cpu_present_set, &cpu_present_setsize);
-  if (ret != 0)
-    goto err;
-  ret = allocate_cpu_set(&cpu_affinity_set, &cpu_affinity_setsize);
   if (ret != 0)
     goto err;
   ret = allocate_cpu_set(&cpu_saved_affinity_set, &cpu_saved_affinity_setsize);
@@ -1342,6 +1468,236 @@ err:
   return ret;
 }
 
+/*****************************
+ * MSR access setup/teardown *
+ *****************************/
+
+static void free_msr_cpus(void) {
+  if (msr_cpus == NULL)
+    return;
+
+  for (unsigned int i = 0; i <= topology.max_cpu_id; ++i) {
+    if (msr_cpus[i].fd >= 0)
+      close(msr_cpus[i].fd);
+    if (msr_cpus[i].set != NULL)
+      CPU_FREE(msr_cpus[i].set);
+  }
+  sfree(msr_cpus);
+  cpu_affinity_setsize = 0;
+}
+
+static int __attribute__((warn_unused_result)) allocate_msr_cpus(void) {
+  msr_cpus = calloc(topology.max_cpu_id + 1, sizeof(*msr_cpus));
+  if (msr_cpus == NULL) {
+    ERROR("turbostat plugin: calloc failed");
+    return -1;
+  }
+
+  for (unsigned int i = 0; i <= topology.max_cpu_id; ++i)
+    msr_cpus[i].fd = -1;
+
+  for (unsigned int i = 0; i <= topology.max_cpu_id; ++i) {
+    if (cpu_is_not_present(i))
+      continue;
+    if (allocate_cpu_set(&msr_cpus[i].set, &cpu_affinity_setsize) != 0) {
+      free_msr_cpus();
+      return -1;
+    }
+    CPU_SET_S(i, cpu_affinity_setsize, msr_cpus[i].set);
+  }
+
+  return 0;
+}
+
+static void free_msr_batch(void) {
+  if (msr_batch_fd >= 0)
+    close(msr_batch_fd);
+  msr_batch_fd = -1;
+  sfree(msr_batch.ops);
+  msr_batch.numops = 0;
+  msr_batch_size = 0;
+  msr_access = MSR_ACCESS_DIRECT;
+}
+
+/*
+ * Use the msr-safe batch device if it is available and allows all the MSRs
+ * we need, otherwise fall back to reading the MSRs one by one
+ */
+static void setup_msr_batch(void) {
+  msr_batch_fd = open(MSR_BATCH_DEVICE, O_RDWR);
+  if (msr_batch_fd < 0) {
+    DEBUG("turbostat plugin: Cannot open " MSR_BATCH_DEVICE ": %s",
+          STRERRNO);
+    return;
+  }
+
+  msr_access = MSR_ACCESS_BATCH_RECORD;
+  int ret = for_all_cpus(get_counters, EVEN_COUNTERS);
+  msr_access = MSR_ACCESS_DIRECT;
+
+  if (ret == 0 && ioctl(msr_batch_fd, X86_IOC_MSR_BATCH, &msr_batch) != 0) {
+    INFO("turbostat plugin: Reading the MSRs through " MSR_BATCH_DEVICE
+         " failed, reading them one by one instead: %s",
+         STRERRNO);
+    ret = -1;
+  }
+  if (ret != 0) {
+    free_msr_batch();
+    return;
+  }
+
+  INFO("turbostat plugin: Reading %" PRIu32
+       " MSRs with one ioctl on " MSR_BATCH_DEVICE ".",
+       msr_batch.numops);
+  msr_access = MSR_ACCESS_BATCH_REPLAY;
+}
+
+/*
+ * Package reader threads: each reads the MSRs of the CPUs of its package and
+ * stays pinned to that package in between. turbostat_read() hands out the
+ * counters to fill by incrementing pkg_generation and waits until all
+ * readers are done.
+ */
+static struct pkg_reader {
+  unsigned int pkg_no;
+  cpu_set_t *set;
+  pthread_t thread;
+  bool running;
+} * pkg_readers;
+static size_t pkg_readers_num;
+
+static pthread_mutex_t pkg_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pkg_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pkg_done_cond = PTHREAD_COND_INITIALIZER;
+static uint64_t pkg_generation;
+static size_t pkg_pending;
+static int pkg_status;
+static bool pkg_shutdown;
+static struct thread_data *pkg_thread_base;
+static struct core_data *pkg_core_base;
+static struct pkg_data *pkg_pkg_base;
+
+static void *pkg_reader_thread(void *arg) {
+  struct pkg_reader *r = arg;
+
+  if (sched_setaffinity(0, cpu_affinity_setsize, r->set) == -1)
+    WARNING("turbostat plugin: Could not pin the reader of package %u: %s",
+            r->pkg_no, STRERRNO);
+
+  pthread_mutex_lock(&pkg_lock);
+  uint64_t generation = pkg_generation;
+  while (!pkg_shutdown) {
+    if (generation == pkg_generation) {
+      pthread_cond_wait(&pkg_cond, &pkg_lock);
+      continue;
+    }
+    generation = pkg_generation;
+
+    struct thread_data *t = pkg_thread_base;
+    struct core_data *c = pkg_core_base;
+    struct pkg_data *p = pkg_pkg_base;
+    pthread_mutex_unlock(&pkg_lock);
+
+    int status = for_package_cpus(r->pkg_no, get_counters, t, c, p);
+    /* get_counters() moved us to the last CPU, go back to the package */
+    (void)sched_setaffinity(0, cpu_affinity_setsize, r->set);
+
+    pthread_mutex_lock(&pkg_lock);
+    if (status != 0)
+      pkg_status = status;
+    if (--pkg_pending == 0)
+      pthread_cond_signal(&pkg_done_cond);
+  }
+  pthread_mutex_unlock(&pkg_lock);
+
+  return NULL;
+}
+
+static int __attribute__((warn_unused_result))
+run_pkg_readers(struct thread_data *t, struct core_data *c,
+                struct pkg_data *p) {
+  pthread_mutex_lock(&pkg_lock);
+  pkg_thread_base = t;
+  pkg_core_base = c;
+  pkg_pkg_base = p;
+  pkg_status = 0;
+  pkg_pending = pkg_readers_num;
+  pkg_generation++;
+  pthread_cond_broadcast(&pkg_cond);
+
+  while (pkg_pending > 0)
+    pthread_cond_wait(&pkg_done_cond, &pkg_lock);
+  int status = pkg_status;
+  pthread_mutex_unlock(&pkg_lock);
+
+  return status;
+}
+
+static void stop_pkg_readers(void) {
+  if (pkg_readers == NULL)
+    return;
+
+  pthread_mutex_lock(&pkg_lock);
+  pkg_shutdown = true;
+  pthread_cond_broadcast(&pkg_cond);
+  pthread_mutex_unlock(&pkg_lock);
+
+  for (size_t i = 0; i < pkg_readers_num; i++) {
+    if (pkg_readers[i].running)
+      pthread_join(pkg_readers[i].thread, NULL);
+    if (pkg_readers[i].set != NULL)
+      CPU_FREE(pkg_readers[i].set);
+  }
+  sfree(pkg_readers);
+  pkg_readers_num = 0;
+  pkg_shutdown = false;
+}
+
+static int __attribute__((warn_unused_result)) start_pkg_readers(void) {
+  pkg_readers = calloc(topology.num_packages, sizeof(*pkg_readers));
+  if (pkg_readers == NULL) {
+    ERROR("turbostat plugin: calloc failed");
+    return -1;
+  }
+
+  /* one reader for each package with at least one present CPU */
+  for (unsigned int pkg_no = 0; pkg_no < topology.num_packages; ++pkg_no) {
+    struct pkg_reader *r = pkg_readers + pkg_readers_num;
+    size_t setsize;
+
+    if (allocate_cpu_set(&r->set, &setsize) != 0)
+      goto err;
+    for (unsigned int i = 0; i <= topology.max_cpu_id; ++i)
+      if (!cpu_is_not_present(i) && (topology.cpus[i].package_id == pkg_no))
+        CPU_SET_S(i, setsize, r->set);
+    if (CPU_COUNT_S(setsize, r->set) == 0) {
+      CPU_FREE(r->set);
+      r->set = NULL;
+      continue;
+    }
+    r->pkg_no = pkg_no;
+    pkg_readers_num++;
+  }
+
+  for (size_t i = 0; i < pkg_readers_num; i++) {
+    char name[16];
+    snprintf(name, sizeof(name), "turbostat pkg%u", pkg_readers[i].pkg_no);
+    int status = plugin_thread_create(&pkg_readers[i].thread,
+                                      pkg_reader_thread, pkg_readers + i, name);
+    if (status != 0) {
+      ERROR("turbostat plugin: Creating the reader of package %u failed: %s",
+            pkg_readers[i].pkg_no, STRERROR(status));
+      goto err;
+    }
+    pkg_readers[i].running = true;
+  }
+
+  return 0;
+err:
+  stop_pkg_readers();
+  return -1;
+}
+
 /************************
  * Main alloc/init/free *
  ************************/
@@ -1426,14 +1782,14 @@ static void free_all_buffers(void) {
   allocated = false;
   initialized = false;
 
+  stop_pkg_readers();
+  free_msr_batch();
+  free_msr_cpus();
+
   CPU_FREE(cpu_present_set);
   cpu_present_set = NULL;
   cpu_present_setsize = 0;
 
-  CPU_FREE(cpu_affinity_set);
-  cpu_affinity_set = NULL;
-  cpu_affinity_setsize = 0;
-
   CPU_FREE(cpu_saved_affinity_set);
   cpu_saved_affinity_set = NULL;
   cpu_saved_affinity_setsize = 0;
@@ -1484,6 +1840,11 @@ static int setup_all_buffers(void) {
   initialize_counters();
   DO_OR_GOTO_ERR(for_all_cpus(set_temperature_target, EVEN_COUNTERS));
   DO_OR_GOTO_ERR(for_all_cpus(set_temperature_target, ODD_COUNTERS));
+  DO_OR_GOTO_ERR(allocate_msr_cpus());
+
+  setup_msr_batch();
+  if (config_package_threads && (msr_access == MSR_ACCESS_DIRECT))
+    DO_OR_GOTO_ERR(start_pkg_readers());
 
   allocated = true;
   return 0;
@@ -1516,6 +1877,40 @@ static void restore_affinity(void) {
   }
 }
 
+/*
+ * Read the counters of all CPUs, using the msr-safe batch, the package
+ * readers or reading them one CPU after the other from this thread
+ */
+static int __attribute__((warn_unused_result))
+read_counters(struct thread_data *t, struct core_data *c, struct pkg_data *p) {
+  int ret;
+
+  if (msr_access == MSR_ACCESS_BATCH_REPLAY) {
+    if (ioctl(msr_batch_fd, X86_IOC_MSR_BATCH, &msr_batch) != 0) {
+      ERROR("turbostat plugin: Reading the MSRs through " MSR_BATCH_DEVICE
+            " failed: %s",
+            STRERRNO);
+      return -1;
+    }
+    msr_batch_pos = 0;
+    return for_all_cpus(get_counters, t, c, p);
+  }
+
+  if (pkg_readers != NULL)
+    return run_pkg_readers(t, c, p);
+
+  if (save_affinity() != 0) {
+    ERROR("turbostat plugin: Unable to save the CPU affinity. Please read the "
+          "docs about RestoreAffinityPolicy option.");
+    return -1;
+  }
+
+  ret = for_all_cpus(get_counters, t, c, p);
+
+  restore_affinity();
+  return ret;
+}
+
 static int turbostat_read(void) {
   int ret;
 
@@ -1535,14 +1930,8 @@ static int turbostat_read(void) {
     }
   }
 
-  if (save_affinity() != 0) {
-    ERROR("turbostat plugin: Unable to save the CPU affinity. Please read the "
-          "docs about RestoreAffinityPolicy option.");
-    return -1;
-  }
-
   if (!initialized) {
-    if ((ret = for_all_cpus(get_counters, EVEN_COUNTERS)) < 0)
+    if ((ret = read_counters(EVEN_COUNTERS)) < 0)
       goto out;
     time_even = cdtime();
     is_even = true;
@@ -1552,7 +1941,7 @@ static int turbostat_read(void) {
   }
 
   if (is_even) {
-    if ((ret = for_all_cpus(get_counters, ODD_COUNTERS)) < 0)
+    if ((ret = read_counters(ODD_COUNTERS)) < 0)
       goto out;
     time_odd = cdtime();
     is_even = false;
@@ -1562,7 +1951,7 @@ static int turbostat_read(void) {
     if ((ret = for_all_cpus(submit_counters, DELTA_COUNTERS)) < 0)
       goto out;
   } else {
-    if ((ret = for_all_cpus(get_counters, EVEN_COUNTERS)) < 0)
+    if ((ret = read_counters(EVEN_COUNTERS)) < 0)
       goto out;
     time_even = cdtime();
     is_even = true;
@@ -1574,8 +1963,6 @@ static int turbostat_read(void) {
   }
   ret = 0;
 out:
-  restore_affinity();
-
   return ret;
 }
 
@@ -1692,6 +2079,8 @@ static int turbostat_config(const char *key, const char *value) {
       return -1;
     }
     tcc_activation_temp = (unsigned int)tmp_val;
+  } else if (strcasecmp("PackageThreads", key) == 0) {
+    config_package_threads = IS_TRUE(value);
   } else if (strcasecmp("RestoreAffinityPolicy", key) == 0) {
     if (strcasecmp("Restore", value) == 0)
       affinity_policy = policy_restore_affinity;
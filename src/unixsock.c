@@ -24,15 +24,22 @@
  *   Florian octo Forster <octo at collectd.org>
  **/
 
+#define _GNU_SOURCE /* For accept4, fopencookie and pipe2 */
+
 #include "collectd.h"
 
+#include "configfile.h"
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils_complain.h"
 
 #include "utils/cmds/flush.h"
 #include "utils/cmds/getthreshold.h"
+#include "utils/cmds/gethistory.h"
 #include "utils/cmds/getval.h"
+#include "utils/cmds/getvals.h"
 #include "utils/cmds/listval.h"
+#include "utils/cmds/memstats.h"
 #include "utils/cmds/putnotif.h"
 #include "utils/cmds/putval.h"
 
@@ -41,18 +48,27 @@
 
 #include <grp.h>
 
+#if HAVE_SYS_EPOLL_H
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#endif
+
 #ifndef UNIX_PATH_MAX
 #define UNIX_PATH_MAX sizeof(((struct sockaddr_un *)0)->sun_path)
 #endif
 
 #define US_DEFAULT_PATH LOCALSTATEDIR "/run/" PACKAGE_NAME "-unixsock"
 
+/* Maximum length of a command line, including the newline. */
+#define US_LINE_MAX 4096
+
 /*
  * Private variables
  */
 /* valid configuration file keys */
 static const char *config_keys[] = {"SocketFile", "SocketGroup", "SocketPerms",
-                                    "DeleteSocket"};
+                                    "DeleteSocket", "Threads"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static int loop;
@@ -63,8 +79,11 @@ static char *sock_file;
 static char *sock_group;
 static int sock_perms = S_IRWXU | S_IRWXG;
 static bool delete_socket;
+static size_t threads_num = 2;
 
+#if !HAVE_SYS_EPOLL_H
 static pthread_t listen_thread = (pthread_t)0;
+#endif
 
 /*
  * Functions
@@ -158,6 +177,460 @@ static int us_open_socket(void) {
   return 0;
 } /* int us_open_socket */
 
+/* Runs one command line and writes the response to `fhout'. Returns non-zero
+ * if the connection should be closed. */
+static int us_handle_command(FILE *fhout, char *buffer) /* {{{ */
+{
+  char buffer_copy[1024];
+  char *fields[128];
+  int fields_num;
+
+  sstrncpy(buffer_copy, buffer, sizeof(buffer_copy));
+
+  fields_num = strsplit(buffer_copy, fields, sizeof(fields) / sizeof(fields[0]));
+  if (fields_num < 1) {
+    fprintf(fhout, "-1 Internal error\n");
+    return -1;
+  }
+
+  if (strcasecmp(fields[0], "getval") == 0) {
+    cmd_handle_getval(fhout, buffer);
+  } else if (strcasecmp(fields[0], "getvals") == 0) {
+    cmd_handle_getvals(fhout, buffer);
+  } else if (strcasecmp(fields[0], "gethistory") == 0) {
+    cmd_handle_gethistory(fhout, buffer);
+  } else if (strcasecmp(fields[0], "getthreshold") == 0) {
+    handle_getthreshold(fhout, buffer);
+  } else if (strcasecmp(fields[0], "putval") == 0) {
+    cmd_handle_putval(fhout, buffer);
+  } else if (strcasecmp(fields[0], "listval") == 0) {
+    cmd_handle_listval(fhout, buffer);
+  } else if (strcasecmp(fields[0], "memstats") == 0) {
+    handle_memstats(fhout, buffer);
+  } else if (strcasecmp(fields[0], "putnotif") == 0) {
+    handle_putnotif(fhout, buffer);
+  } else if (strcasecmp(fields[0], "flush") == 0) {
+    cmd_handle_flush(fhout, buffer);
+  } else if (strcasecmp(fields[0], "reload") == 0) {
+    cf_request_reload();
+    fprintf(fhout, "0 Reload requested\n");
+  } else {
+    if (fprintf(fhout, "-1 Unknown command: %s\n", fields[0]) < 0) {
+      WARNING("unixsock plugin: failed to write to socket #%i: %s",
+              fileno(fhout), STRERRNO);
+      return -1;
+    }
+  }
+
+  return 0;
+} /* }}} int us_handle_command */
+
+#if HAVE_SYS_EPOLL_H
+/*
+ * Connections are served by a small pool of threads sharing one epoll(7)
+ * instance. Every connection is registered with EPOLLONESHOT, so only one
+ * worker handles it at a time; the worker re-arms it when done. The commands
+ * of a connection are run in order and their responses are collected in an
+ * output buffer, which is written without blocking. While a response is
+ * pending no further input is read from that connection. Large responses,
+ * e.g. of LISTVAL, are streamed: once US_OUTPUT_HIGH_WATER bytes are pending,
+ * the worker waits for the client to read them before the command continues.
+ */
+#define US_OUTPUT_HIGH_WATER (256 * 1024)
+#define US_OUTPUT_TIMEOUT_MS 30000
+
+typedef struct us_conn_s {
+  int fd;
+  char in[US_LINE_MAX];
+  size_t in_len;
+  char *out;
+  size_t out_size;
+  size_t out_len;
+  size_t out_pos;
+  bool out_failed;
+  bool eof;
+  struct us_conn_s *prev;
+  struct us_conn_s *next;
+} us_conn_t;
+
+static int epoll_fd = -1;
+static int wakeup_pipe[2] = {-1, -1};
+static pthread_t *worker_threads;
+static size_t worker_threads_num;
+static us_conn_t *conn_head;
+static pthread_mutex_t conn_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Markers for the two file descriptors that are not connections. */
+static char listen_marker;
+static char wakeup_marker;
+
+static void us_conn_destroy(us_conn_t *c) /* {{{ */
+{
+  pthread_mutex_lock(&conn_lock);
+  if (c->prev != NULL)
+    c->prev->next = c->next;
+  else
+    conn_head = c->next;
+  if (c->next != NULL)
+    c->next->prev = c->prev;
+  pthread_mutex_unlock(&conn_lock);
+
+  DEBUG("unixsock plugin: Closing connection on fd #%i", c->fd);
+  close(c->fd);
+  sfree(c->out);
+  sfree(c);
+} /* }}} void us_conn_destroy */
+
+static void us_conn_accept(void) /* {{{ */
+{
+  static c_complain_t complaint = C_COMPLAIN_INIT_STATIC;
+
+  while (42) {
+    int fd = accept4(sock_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+        c_complain(LOG_ERR, &complaint, "unixsock plugin: accept failed: %s",
+                   STRERRNO);
+      return;
+    }
+    c_release(LOG_INFO, &complaint,
+              "unixsock plugin: Accepting connections again.");
+
+    us_conn_t *c = calloc(1, sizeof(*c));
+    if (c == NULL) {
+      ERROR("unixsock plugin: calloc failed.");
+      close(fd);
+      continue;
+    }
+    c->fd = fd;
+
+    pthread_mutex_lock(&conn_lock);
+    c->next = conn_head;
+    if (c->next != NULL)
+      c->next->prev = c;
+    conn_head = c;
+    pthread_mutex_unlock(&conn_lock);
+
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLONESHOT, .data.ptr = c};
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+      ERROR("unixsock plugin: epoll_ctl failed: %s", STRERRNO);
+      us_conn_destroy(c);
+    }
+  }
+} /* }}} void us_conn_accept */
+
+/* Writes as much of the pending output as possible. Returns non-zero on
+ * error. */
+static int us_conn_write(us_conn_t *c) /* {{{ */
+{
+  while (c->out_pos < c->out_len) {
+    ssize_t status = write(c->fd, c->out + c->out_pos, c->out_len - c->out_pos);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        return 0;
+      WARNING("unixsock plugin: failed to write to socket #%i: %s", c->fd,
+              STRERRNO);
+      return -1;
+    }
+    c->out_pos += (size_t)status;
+  }
+
+  sfree(c->out);
+  c->out_size = 0;
+  c->out_len = 0;
+  c->out_pos = 0;
+  return 0;
+} /* }}} int us_conn_write */
+
+static int us_conn_append(us_conn_t *c, const char *buf, size_t size) /* {{{ */
+{
+  if (c->out_len + size > c->out_size) {
+    /* Drop what has been written already before growing the buffer. */
+    if (c->out_pos > 0) {
+      memmove(c->out, c->out + c->out_pos, c->out_len - c->out_pos);
+      c->out_len -= c->out_pos;
+      c->out_pos = 0;
+    }
+
+    size_t new_size = (c->out_size > 0) ? c->out_size : 4096;
+    while (new_size < c->out_len + size)
+      new_size *= 2;
+
+    if (new_size > c->out_size) {
+      char *tmp = realloc(c->out, new_size);
+      if (tmp == NULL) {
+        ERROR("unixsock plugin: realloc failed.");
+        return -1;
+      }
+      c->out = tmp;
+      c->out_size = new_size;
+    }
+  }
+
+  memcpy(c->out + c->out_len, buf, size);
+  c->out_len += size;
+  return 0;
+} /* }}} int us_conn_append */
+
+/* Write function of the stream passed to the command handlers. */
+static ssize_t us_conn_stream_write(void *cookie, const char *buf, /* {{{ */
+                                    size_t size) {
+  us_conn_t *c = cookie;
+
+  if (c->out_failed)
+    return 0;
+
+  if (us_conn_append(c, buf, size) != 0) {
+    c->out_failed = true;
+    return 0;
+  }
+
+  while ((c->out_len - c->out_pos) >= US_OUTPUT_HIGH_WATER) {
+    if (us_conn_write(c) != 0) {
+      c->out_failed = true;
+      return 0;
+    }
+    if ((c->out_len - c->out_pos) < US_OUTPUT_HIGH_WATER)
+      break;
+
+    struct pollfd pfd = {.fd = c->fd, .events = POLLOUT};
+    int status = poll(&pfd, 1, US_OUTPUT_TIMEOUT_MS);
+    if ((status < 0) && (errno == EINTR))
+      continue;
+    if (status <= 0) {
+      WARNING("unixsock plugin: Client on socket #%i does not read its "
+              "responses, closing the connection.",
+              c->fd);
+      c->out_failed = true;
+      return 0;
+    }
+  }
+
+  return (ssize_t)size;
+} /* }}} ssize_t us_conn_stream_write */
+
+/* Runs all complete lines in the input buffer. Returns non-zero if the
+ * connection should be closed once the output has been written. */
+static int us_conn_run_commands(us_conn_t *c) /* {{{ */
+{
+  size_t pos = 0;
+  int status = 0;
+
+  FILE *fhout =
+      fopencookie(c, "w", (cookie_io_functions_t){.write = us_conn_stream_write});
+  if (fhout == NULL) {
+    ERROR("unixsock plugin: fopencookie failed: %s", STRERRNO);
+    return -1;
+  }
+
+  while ((status == 0) && !c->out_failed) {
+    char *line = c->in + pos;
+    char *eol = memchr(line, '\n', c->in_len - pos);
+    if (eol == NULL)
+      break;
+    *eol = 0;
+    pos = (eol - c->in) + 1;
+
+    size_t len = eol - line;
+    while ((len > 0) && ((line[len - 1] == '\r') || (line[len - 1] == '\n')))
+      line[--len] = 0;
+    if (len == 0)
+      continue;
+
+    status = us_handle_command(fhout, line);
+  }
+
+  memmove(c->in, c->in + pos, c->in_len - pos);
+  c->in_len -= pos;
+
+  if ((status == 0) && (c->in_len >= sizeof(c->in))) {
+    fprintf(fhout, "-1 Line too long\n");
+    status = -1;
+  }
+
+  fclose(fhout);
+
+  return c->out_failed ? -1 : status;
+} /* }}} int us_conn_run_commands */
+
+/* Reads the available input and runs the commands. Returns non-zero on error
+ * or when the client went away. */
+static int us_conn_read(us_conn_t *c) /* {{{ */
+{
+  while (!c->eof) {
+    ssize_t status = read(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        return 0;
+      WARNING("unixsock plugin: failed to read from socket #%i: %s", c->fd,
+              STRERRNO);
+      return -1;
+    } else if (status == 0) {
+      /* Run a last command that isn't terminated by a newline. */
+      if ((c->in_len > 0) && (c->in_len < sizeof(c->in)))
+        c->in[c->in_len++] = '\n';
+      c->eof = true;
+    } else {
+      c->in_len += (size_t)status;
+    }
+
+    if (us_conn_run_commands(c) != 0)
+      c->eof = true;
+
+    /* Let the client read its responses before accepting more commands. */
+    if (c->out_len > c->out_pos) {
+      if (us_conn_write(c) != 0)
+        return -1;
+      if (c->out_len > c->out_pos)
+        return 0;
+    }
+  }
+
+  return 0;
+} /* }}} int us_conn_read */
+
+static void us_conn_handle(us_conn_t *c, uint32_t events) /* {{{ */
+{
+  int status = 0;
+
+  if (c->out_len > c->out_pos)
+    status = us_conn_write(c);
+  if ((status == 0) && (c->out_len == c->out_pos) &&
+      ((events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0))
+    status = us_conn_read(c);
+
+  if ((status != 0) || c->out_failed ||
+      (c->eof && (c->out_len == c->out_pos))) {
+    us_conn_destroy(c);
+    return;
+  }
+
+  struct epoll_event ev = {
+      .events = ((c->out_len > c->out_pos) ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT,
+      .data.ptr = c};
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c->fd, &ev) != 0) {
+    ERROR("unixsock plugin: epoll_ctl failed: %s", STRERRNO);
+    us_conn_destroy(c);
+  }
+} /* }}} void us_conn_handle */
+
+static void *us_worker_thread(void __attribute__((unused)) * arg) /* {{{ */
+{
+  struct epoll_event events[16];
+
+  while (loop != 0) {
+    int events_num =
+        epoll_wait(epoll_fd, events, STATIC_ARRAY_SIZE(events), -1);
+    if (events_num < 0) {
+      if (errno == EINTR)
+        continue;
+      ERROR("unixsock plugin: epoll_wait failed: %s", STRERRNO);
+      break;
+    }
+
+    for (int i = 0; i < events_num; i++) {
+      if (events[i].data.ptr == &wakeup_marker)
+        continue;
+      else if (events[i].data.ptr == &listen_marker)
+        us_conn_accept();
+      else
+        us_conn_handle(events[i].data.ptr, events[i].events);
+    }
+  }
+
+  return (void *)0;
+} /* }}} void *us_worker_thread */
+
+static int us_server_start(void) /* {{{ */
+{
+  if (us_open_socket() != 0)
+    return -1;
+
+  int flags = fcntl(sock_fd, F_GETFL);
+  if ((flags < 0) || (fcntl(sock_fd, F_SETFL, flags | O_NONBLOCK) != 0)) {
+    ERROR("unixsock plugin: fcntl failed: %s", STRERRNO);
+    return -1;
+  }
+
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd < 0) {
+    ERROR("unixsock plugin: epoll_create1 failed: %s", STRERRNO);
+    return -1;
+  }
+
+  if (pipe2(wakeup_pipe, O_CLOEXEC) != 0) {
+    ERROR("unixsock plugin: pipe2 failed: %s", STRERRNO);
+    return -1;
+  }
+
+  struct epoll_event ev_listen = {.events = EPOLLIN, .data.ptr = &listen_marker};
+  struct epoll_event ev_wakeup = {.events = EPOLLIN, .data.ptr = &wakeup_marker};
+  if ((epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sock_fd, &ev_listen) != 0) ||
+      (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wakeup_pipe[0], &ev_wakeup) != 0)) {
+    ERROR("unixsock plugin: epoll_ctl failed: %s", STRERRNO);
+    return -1;
+  }
+
+  worker_threads = calloc(threads_num, sizeof(*worker_threads));
+  if (worker_threads == NULL) {
+    ERROR("unixsock plugin: calloc failed.");
+    return -1;
+  }
+
+  for (size_t i = 0; i < threads_num; i++) {
+    int status = plugin_thread_create(worker_threads + worker_threads_num,
+                                      us_worker_thread, NULL, "unixsock worker");
+    if (status != 0) {
+      ERROR("unixsock plugin: pthread_create failed: %s", STRERRNO);
+      break;
+    }
+    worker_threads_num++;
+  }
+
+  return (worker_threads_num > 0) ? 0 : -1;
+} /* }}} int us_server_start */
+
+static void us_server_stop(void) /* {{{ */
+{
+  /* The pipe stays readable, so every worker wakes up and sees loop == 0. */
+  if (wakeup_pipe[1] >= 0) {
+    if (write(wakeup_pipe[1], "", 1) < 0)
+      ERROR("unixsock plugin: write to wakeup pipe failed: %s", STRERRNO);
+  }
+
+  for (size_t i = 0; i < worker_threads_num; i++)
+    pthread_join(worker_threads[i], NULL);
+  sfree(worker_threads);
+  worker_threads_num = 0;
+
+  while (conn_head != NULL)
+    us_conn_destroy(conn_head);
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(wakeup_pipe); i++) {
+    if (wakeup_pipe[i] >= 0)
+      close(wakeup_pipe[i]);
+    wakeup_pipe[i] = -1;
+  }
+  if (epoll_fd >= 0)
+    close(epoll_fd);
+  epoll_fd = -1;
+
+  if (sock_fd >= 0) {
+    close(sock_fd);
+    sock_fd = -1;
+
+    int status = unlink((sock_file != NULL) ? sock_file : US_DEFAULT_PATH);
+    if (status != 0) {
+      NOTICE("unixsock plugin: unlink (%s) failed: %s",
+             (sock_file != NULL) ? sock_file : US_DEFAULT_PATH, STRERRNO);
+    }
+  }
+} /* }}} void us_server_stop */
+#else  /* !HAVE_SYS_EPOLL_H */
 static void *us_handle_client(void *arg) {
   int fdin;
   int fdout;
@@ -205,9 +678,6 @@ static void *us_handle_client(void *arg) {
 
   while (42) {
     char buffer[1024];
-    char buffer_copy[1024];
-    char *fields[128];
-    int fields_num;
 
     errno = 0;
     if (fgets(buffer, sizeof(buffer), fhin) == NULL) {
@@ -229,37 +699,8 @@ static void *us_handle_client(void *arg) {
     if (len == 0)
       continue;
 
-    sstrncpy(buffer_copy, buffer, sizeof(buffer_copy));
-
-    fields_num =
-        strsplit(buffer_copy, fields, sizeof(fields) / sizeof(fields[0]));
-    if (fields_num < 1) {
-      fprintf(fhout, "-1 Internal error\n");
-      fclose(fhin);
-      fclose(fhout);
-      pthread_exit((void *)1);
-      return (void *)1;
-    }
-
-    if (strcasecmp(fields[0], "getval") == 0) {
-      cmd_handle_getval(fhout, buffer);
-    } else if (strcasecmp(fields[0], "getthreshold") == 0) {
-      handle_getthreshold(fhout, buffer);
-    } else if (strcasecmp(fields[0], "putval") == 0) {
-      cmd_handle_putval(fhout, buffer);
-    } else if (strcasecmp(fields[0], "listval") == 0) {
-      cmd_handle_listval(fhout, buffer);
-    } else if (strcasecmp(fields[0], "putnotif") == 0) {
-      handle_putnotif(fhout, buffer);
-    } else if (strcasecmp(fields[0], "flush") == 0) {
-      cmd_handle_flush(fhout, buffer);
-    } else {
-      if (fprintf(fhout, "-1 Unknown command: %s\n", fields[0]) < 0) {
-        WARNING("unixsock plugin: failed to write to socket #%i: %s",
-                fileno(fhout), STRERRNO);
-        break;
-      }
-    }
+    if (us_handle_command(fhout, buffer) != 0)
+      break;
   } /* while (fgets) */
 
   DEBUG("unixsock plugin: us_handle_client: Exiting..");
@@ -326,6 +767,8 @@ static void *us_server_thread(void __attribute__((unused)) * arg) {
   return (void *)0;
 } /* void *us_server_thread */
 
+#endif /* HAVE_SYS_EPOLL_H */
+
 static int us_config(const char *key, const char *val) {
   if (strcasecmp(key, "SocketFile") == 0) {
     char *new_sock_file = strdup(val);
@@ -348,6 +791,15 @@ static int us_config(const char *key, const char *val) {
       delete_socket = true;
     else
       delete_socket = false;
+  } else if (strcasecmp(key, "Threads") == 0) {
+    int tmp = atoi(val);
+    if ((tmp < 1) || (tmp > 64)) {
+      WARNING("unixsock plugin: Threads must be between 1 and 64, "
+              "got `%s'.",
+              val);
+      return 1;
+    }
+    threads_num = (size_t)tmp;
   } else {
     return -1;
   }
@@ -367,26 +819,39 @@ static int us_init(void) {
 
   loop = 1;
 
+#if HAVE_SYS_EPOLL_H
+  status = us_server_start();
+  if (status != 0) {
+    loop = 0;
+    us_server_stop();
+    return -1;
+  }
+#else
   status = plugin_thread_create(&listen_thread, us_server_thread, NULL,
                                 "unixsock listen");
   if (status != 0) {
     ERROR("unixsock plugin: pthread_create failed: %s", STRERRNO);
     return -1;
   }
+#endif
 
   return 0;
 } /* int us_init */
 
 static int us_shutdown(void) {
-  void *ret;
-
   loop = 0;
 
+#if HAVE_SYS_EPOLL_H
+  us_server_stop();
+#else
   if (listen_thread != (pthread_t)0) {
+    void *ret;
+
     pthread_kill(listen_thread, SIGTERM);
     pthread_join(listen_thread, &ret);
     listen_thread = (pthread_t)0;
   }
+#endif
 
   plugin_unregister_init("unixsock");
   plugin_unregister_shutdown("unixsock");
@@ -1,6 +1,7 @@
 /**
  * collectd - src/utils_avltree.c
  * Copyright (C) 2006,2007  Florian octo Forster
+ * Copyright (C) 2026       collectd.org
  *
  * Permission is hereby granted, free of charge, to any person obtaining a
  * copy of this software and associated documentation files (the "Software"),
@@ -24,26 +25,53 @@
  *   Florian octo Forster <octo at collectd.org>
  **/
 
+/*
+ * Despite the name, this is a B+-tree: all key-value-pairs live in the
+ * leaves, which are linked for iteration, and inner nodes hold separator keys
+ * only. Every separator is the (pointer-identical) smallest key of the
+ * subtree to its right, so no key is referenced by the tree after it has been
+ * removed and the caller may free it right away, just like with the AVL-tree
+ * this replaces.
+ */
+
 #include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "utils/avltree/avltree.h"
+#include "utils/memstats/memstats.h"
+
+/* Maximum number of keys per node. Nodes have room for one more so that
+ * inserting can overflow a node before it is split. */
+#define BT_MAX_KEYS 16
+#define BT_MIN_KEYS (BT_MAX_KEYS / 2)
+
+/* With at least BT_MIN_KEYS + 1 children per inner node, 32 levels are more
+ * than an "int" sized tree will ever need. */
+#define BT_MAX_DEPTH 32
 
-#define BALANCE(n)                                                             \
-  ((((n)->left == NULL) ? 0 : (n)->left->height) -                             \
-   (((n)->right == NULL) ? 0 : (n)->right->height))
+#define BT_NODE_ALIGN 64
 
 /*
  * private data types
  */
 struct c_avl_node_s {
-  void *key;
-  void *value;
-
-  int height;
-  struct c_avl_node_s *left;
-  struct c_avl_node_s *right;
-  struct c_avl_node_s *parent;
+  int num;
+  bool leaf;
+
+  /* Leaves only: neighbours in key order. */
+  struct c_avl_node_s *prev;
+  struct c_avl_node_s *next;
+
+  /* First eight bytes of each key, if the tree compares with strcmp(). */
+  uint64_t prefix[BT_MAX_KEYS + 1];
+  void *key[BT_MAX_KEYS + 1];
+  union {
+    void *value[BT_MAX_KEYS + 1];
+    struct c_avl_node_s *child[BT_MAX_KEYS + 2];
+  };
 };
 typedef struct c_avl_node_s c_avl_node_t;
 
@@ -51,366 +79,413 @@ struct c_avl_tree_s {
   c_avl_node_t *root;
   int (*compare)(const void *, const void *);
   int size;
+  bool prefix;
+  /* Bumped by every modification so iterators can notice them. */
+  unsigned int generation;
+  /* Plugin that created the tree; the nodes are accounted to it. */
+  memstats_owner_t *owner;
 };
 
 struct c_avl_iterator_s {
   c_avl_tree_t *tree;
   c_avl_node_t *node;
+  int index;
+  void *key;
+  unsigned int generation;
 };
 
+typedef struct {
+  c_avl_node_t *node;
+  int index;
+} bt_path_t;
+
 /*
  * private functions
  */
 #if 0
-static void verify_tree (c_avl_node_t *n)
+static c_avl_node_t *verify_node (c_avl_tree_t *t, c_avl_node_t *n,
+    int depth, int *leaf_depth, c_avl_node_t *prev_leaf)
 {
-	if (n == NULL)
-		return;
-
-	verify_tree (n->left);
-	verify_tree (n->right);
+	if (n != t->root)
+		assert (n->num >= BT_MIN_KEYS);
+	assert (n->num <= BT_MAX_KEYS);
+
+	for (int i = 1; i < n->num; i++)
+		assert (t->compare (n->key[i - 1], n->key[i]) < 0);
+
+	if (n->leaf) {
+		if (*leaf_depth < 0)
+			*leaf_depth = depth;
+		assert (*leaf_depth == depth);
+		assert (n->prev == prev_leaf);
+		assert ((prev_leaf == NULL) || (prev_leaf->next == n));
+		return n;
+	}
+
+	for (int i = 0; i <= n->num; i++) {
+		c_avl_node_t *c = n->child[i];
+		if (i > 0) {
+			c_avl_node_t *first = c;
+			while (!first->leaf)
+				first = first->child[0];
+			assert (n->key[i - 1] == first->key[0]);
+		}
+		prev_leaf = verify_node (t, c, depth + 1, leaf_depth, prev_leaf);
+	}
+	return prev_leaf;
+} /* void verify_node */
+
+static void verify_tree (c_avl_tree_t *t)
+{
+	int leaf_depth = -1;
 
-	assert ((BALANCE (n) >= -1) && (BALANCE (n) <= 1));
-	assert ((n->parent == NULL) || (n->parent->right == n) || (n->parent->left == n));
+	if (t->root == NULL)
+		return;
+	assert (verify_node (t, t->root, 0, &leaf_depth, NULL)->next == NULL);
 } /* void verify_tree */
 #else
-#define verify_tree(n) /**/
+#define verify_tree(t) /**/
 #endif
 
-static void free_node(c_avl_node_t *n) {
-  if (n == NULL)
-    return;
+/* Returns the first eight bytes of "s" in big-endian order, so that comparing
+ * two prefixes as integers orders them like strcmp() does. The lowest byte is
+ * zero if and only if the string is shorter than eight bytes. */
+static uint64_t key_prefix(const char *s) {
+  uint64_t p = 0;
+  int i;
 
-  if (n->left != NULL)
-    free_node(n->left);
-  if (n->right != NULL)
-    free_node(n->right);
+  for (i = 0; (i < 8) && (s[i] != 0); i++)
+    p = (p << 8) | (uint64_t)(unsigned char)s[i];
 
-  free(n);
+  if (i == 0)
+    return 0;
+  if (i < 8)
+    p <<= 8 * (8 - i);
+  return p;
 }
 
-static int calc_height(c_avl_node_t *n) {
-  int height_left;
-  int height_right;
+static int node_compare(c_avl_tree_t const *t, const void *key, uint64_t kp,
+                        c_avl_node_t const *n, int i) {
+  if (!t->prefix)
+    return t->compare(key, n->key[i]);
 
-  if (n == NULL)
+  if (kp != n->prefix[i])
+    return (kp < n->prefix[i]) ? -1 : 1;
+  /* Equal prefixes that include the terminating null byte. */
+  if ((kp & 0xff) == 0)
     return 0;
+  return strcmp((const char *)key + 8, (const char *)n->key[i] + 8);
+}
 
-  height_left = (n->left == NULL) ? 0 : n->left->height;
-  height_right = (n->right == NULL) ? 0 : n->right->height;
+/* Returns the index of the first key in "n" that is greater than or equal to
+ * "key". "found" is set if it is equal. */
+static int node_locate(c_avl_tree_t const *t, c_avl_node_t const *n,
+                       const void *key, uint64_t kp, bool *found) {
+  int lo = 0;
+  int hi = n->num;
+
+  *found = false;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    int cmp = node_compare(t, key, kp, n, mid);
+    if (cmp == 0) {
+      *found = true;
+      return mid;
+    } else if (cmp < 0) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
 
-  return ((height_left > height_right) ? height_left : height_right) + 1;
-} /* int calc_height */
+  return lo;
+}
 
-static c_avl_node_t *search(c_avl_tree_t *t, const void *key) {
+static c_avl_node_t *node_create(c_avl_tree_t *t, bool leaf) {
   c_avl_node_t *n;
-  int cmp;
 
-  n = t->root;
-  while (n != NULL) {
-    cmp = t->compare(key, n->key);
-    if (cmp == 0)
-      return n;
-    else if (cmp < 0)
-      n = n->left;
-    else
-      n = n->right;
-  }
+  if (posix_memalign((void **)&n, BT_NODE_ALIGN, sizeof(*n)) != 0)
+    return NULL;
 
-  return NULL;
+  memset(n, 0, sizeof(*n));
+  n->leaf = leaf;
+  memstats_add(t->owner, (int64_t)sizeof(*n), 1);
+  return n;
 }
 
-/*         (x)             (y)
- *        /   \           /   \
- *     (y)    /\         /\    (x)
- *    /   \  /_c\  ==>  / a\  /   \
- *   /\   /\           /____\/\   /\
- *  / a\ /_b\               /_b\ /_c\
- * /____\
- */
-static c_avl_node_t *rotate_right(c_avl_tree_t *t, c_avl_node_t *x) {
-  c_avl_node_t *p;
-  c_avl_node_t *y;
-  c_avl_node_t *b;
-
-  assert(x != NULL);
-  assert(x->left != NULL);
-
-  p = x->parent;
-  y = x->left;
-  b = y->right;
-
-  x->left = b;
-  if (b != NULL)
-    b->parent = x;
-
-  x->parent = y;
-  y->right = x;
-
-  y->parent = p;
-  assert((p == NULL) || (p->left == x) || (p->right == x));
-  if (p == NULL)
-    t->root = y;
-  else if (p->left == x)
-    p->left = y;
-  else
-    p->right = y;
-
-  x->height = calc_height(x);
-  y->height = calc_height(y);
+static void node_destroy(c_avl_tree_t *t, c_avl_node_t *n) {
+  memstats_add(t->owner, -(int64_t)sizeof(*n), -1);
+  free(n);
+}
 
-  return y;
-} /* void rotate_right */
+static void free_node(c_avl_tree_t *t, c_avl_node_t *n) {
+  if (n == NULL)
+    return;
 
-/*
- *    (x)                   (y)
- *   /   \                 /   \
- *  /\    (y)           (x)    /\
- * /_a\  /   \   ==>   /   \  / c\
- *      /\   /\       /\   /\/____\
- *     /_b\ / c\     /_a\ /_b\
- *         /____\
- */
-static c_avl_node_t *rotate_left(c_avl_tree_t *t, c_avl_node_t *x) {
-  c_avl_node_t *p;
-  c_avl_node_t *y;
-  c_avl_node_t *b;
-
-  assert(x != NULL);
-  assert(x->right != NULL);
-
-  p = x->parent;
-  y = x->right;
-  b = y->left;
-
-  x->right = b;
-  if (b != NULL)
-    b->parent = x;
-
-  x->parent = y;
-  y->left = x;
-
-  y->parent = p;
-  assert((p == NULL) || (p->left == x) || (p->right == x));
-  if (p == NULL)
-    t->root = y;
-  else if (p->left == x)
-    p->left = y;
-  else
-    p->right = y;
-
-  x->height = calc_height(x);
-  y->height = calc_height(y);
-
-  return y;
-} /* void rotate_left */
-
-static c_avl_node_t *rotate_left_right(c_avl_tree_t *t, c_avl_node_t *x) {
-  rotate_left(t, x->left);
-  return rotate_right(t, x);
-} /* void rotate_left_right */
-
-static c_avl_node_t *rotate_right_left(c_avl_tree_t *t, c_avl_node_t *x) {
-  rotate_right(t, x->right);
-  return rotate_left(t, x);
-} /* void rotate_right_left */
-
-static void rebalance(c_avl_tree_t *t, c_avl_node_t *n) {
-  int b_top;
-  int b_bottom;
-
-  while (n != NULL) {
-    b_top = BALANCE(n);
-    assert((b_top >= -2) && (b_top <= 2));
-
-    if (b_top == -2) {
-      assert(n->right != NULL);
-      b_bottom = BALANCE(n->right);
-      assert((b_bottom >= -1) && (b_bottom <= 1));
-      if (b_bottom == 1)
-        n = rotate_right_left(t, n);
-      else
-        n = rotate_left(t, n);
-    } else if (b_top == 2) {
-      assert(n->left != NULL);
-      b_bottom = BALANCE(n->left);
-      assert((b_bottom >= -1) && (b_bottom <= 1));
-      if (b_bottom == -1)
-        n = rotate_left_right(t, n);
-      else
-        n = rotate_right(t, n);
-    } else {
-      int height = calc_height(n);
-      if (height == n->height)
-        break;
-      n->height = height;
-    }
+  if (!n->leaf)
+    for (int i = 0; i <= n->num; i++)
+      free_node(t, n->child[i]);
 
-    assert(n->height == calc_height(n));
+  node_destroy(t, n);
+}
 
-    n = n->parent;
-  } /* while (n != NULL) */
-} /* void rebalance */
+/* Inserts key, prefix and value (or right child) at "i", shifting the
+ * following entries to the right. */
+static void node_insert_at(c_avl_node_t *n, int i, void *key, uint64_t kp,
+                           void *ptr) {
+  int tail = n->num - i;
 
-static c_avl_node_t *c_avl_node_next(c_avl_node_t *n) {
-  c_avl_node_t *r; /* return node */
+  memmove(n->key + i + 1, n->key + i, tail * sizeof(n->key[0]));
+  memmove(n->prefix + i + 1, n->prefix + i, tail * sizeof(n->prefix[0]));
+  n->key[i] = key;
+  n->prefix[i] = kp;
 
-  if (n == NULL) {
-    return NULL;
+  if (n->leaf) {
+    memmove(n->value + i + 1, n->value + i, tail * sizeof(n->value[0]));
+    n->value[i] = ptr;
+  } else {
+    memmove(n->child + i + 2, n->child + i + 1, tail * sizeof(n->child[0]));
+    n->child[i + 1] = ptr;
   }
 
-  /* If we can't descent any further, we have to backtrack to the first
-   * parent that's bigger than we, i. e. who's _left_ child we are. */
-  if (n->right == NULL) {
-    r = n->parent;
-    while ((r != NULL) && (r->parent != NULL)) {
-      if (r->left == n)
-        break;
-      n = r;
-      r = n->parent;
-    }
+  n->num++;
+}
 
-    /* n->right == NULL && r == NULL => t is root and has no next
-     * r->left != n => r->right = n => r->parent == NULL */
-    if ((r == NULL) || (r->left != n)) {
-      assert((r == NULL) || (r->parent == NULL));
-      return NULL;
-    } else {
-      assert(r->left == n);
-      return r;
-    }
-  } else {
-    r = n->right;
-    while (r->left != NULL)
-      r = r->left;
+/* Removes the key at "i" and the value (or the child to the right of it). */
+static void node_remove_at(c_avl_node_t *n, int i) {
+  int tail = n->num - i - 1;
+
+  memmove(n->key + i, n->key + i + 1, tail * sizeof(n->key[0]));
+  memmove(n->prefix + i, n->prefix + i + 1, tail * sizeof(n->prefix[0]));
+
+  if (n->leaf)
+    memmove(n->value + i, n->value + i + 1, tail * sizeof(n->value[0]));
+  else
+    memmove(n->child + i + 1, n->child + i + 2, tail * sizeof(n->child[0]));
+
+  n->num--;
+}
+
+/* Splits the overflowing node "n" in two, moving the upper half into the
+ * empty node "r". Returns "r" and stores the separator to insert into the
+ * parent in "rkey" / "rkp". */
+static c_avl_node_t *node_split(c_avl_node_t *n, c_avl_node_t *r, void **rkey,
+                                uint64_t *rkp) {
+  int keep = n->num / 2;
+
+  r->leaf = n->leaf;
+  if (n->leaf) {
+    r->num = n->num - keep;
+    memcpy(r->key, n->key + keep, r->num * sizeof(r->key[0]));
+    memcpy(r->prefix, n->prefix + keep, r->num * sizeof(r->prefix[0]));
+    memcpy(r->value, n->value + keep, r->num * sizeof(r->value[0]));
+    n->num = keep;
+
+    r->prev = n;
+    r->next = n->next;
+    if (n->next != NULL)
+      n->next->prev = r;
+    n->next = r;
+
+    *rkey = r->key[0];
+    *rkp = r->prefix[0];
+    return r;
   }
 
-  return r;
-} /* c_avl_node_t *c_avl_node_next */
+  /* The middle key moves up into the parent. */
+  r->num = n->num - keep - 1;
+  memcpy(r->key, n->key + keep + 1, r->num * sizeof(r->key[0]));
+  memcpy(r->prefix, n->prefix + keep + 1, r->num * sizeof(r->prefix[0]));
+  memcpy(r->child, n->child + keep + 1, (r->num + 1) * sizeof(r->child[0]));
+  *rkey = n->key[keep];
+  *rkp = n->prefix[keep];
+  n->num = keep;
 
-static c_avl_node_t *c_avl_node_prev(c_avl_node_t *n) {
-  c_avl_node_t *r; /* return node */
+  return r;
+}
 
-  if (n == NULL) {
-    return NULL;
+/* Moves the last entry of p->child[i - 1] to the front of p->child[i]. */
+static void borrow_left(c_avl_node_t *p, int i) {
+  c_avl_node_t *l = p->child[i - 1];
+  c_avl_node_t *n = p->child[i];
+
+  if (n->leaf) {
+    node_insert_at(n, 0, l->key[l->num - 1], l->prefix[l->num - 1],
+                   l->value[l->num - 1]);
+    l->num--;
+    p->key[i - 1] = n->key[0];
+    p->prefix[i - 1] = n->prefix[0];
+    return;
   }
 
-  /* If we can't descent any further, we have to backtrack to the first
-   * parent that's smaller than we, i. e. who's _right_ child we are. */
-  if (n->left == NULL) {
-    r = n->parent;
-    while ((r != NULL) && (r->parent != NULL)) {
-      if (r->right == n)
-        break;
-      n = r;
-      r = n->parent;
-    }
+  memmove(n->key + 1, n->key, n->num * sizeof(n->key[0]));
+  memmove(n->prefix + 1, n->prefix, n->num * sizeof(n->prefix[0]));
+  memmove(n->child + 1, n->child, (n->num + 1) * sizeof(n->child[0]));
+  n->key[0] = p->key[i - 1];
+  n->prefix[0] = p->prefix[i - 1];
+  n->child[0] = l->child[l->num];
+  n->num++;
+
+  p->key[i - 1] = l->key[l->num - 1];
+  p->prefix[i - 1] = l->prefix[l->num - 1];
+  l->num--;
+}
 
-    /* n->left == NULL && r == NULL => t is root and has no next
-     * r->right != n => r->left = n => r->parent == NULL */
-    if ((r == NULL) || (r->right != n)) {
-      assert((r == NULL) || (r->parent == NULL));
-      return NULL;
-    } else {
-      assert(r->right == n);
-      return r;
-    }
-  } else {
-    r = n->left;
-    while (r->right != NULL)
-      r = r->right;
+/* Moves the first entry of p->child[i + 1] to the end of p->child[i]. */
+static void borrow_right(c_avl_node_t *p, int i) {
+  c_avl_node_t *n = p->child[i];
+  c_avl_node_t *r = p->child[i + 1];
+
+  if (n->leaf) {
+    n->key[n->num] = r->key[0];
+    n->prefix[n->num] = r->prefix[0];
+    n->value[n->num] = r->value[0];
+    n->num++;
+    node_remove_at(r, 0);
+    p->key[i] = r->key[0];
+    p->prefix[i] = r->prefix[0];
+    return;
   }
 
-  return r;
-} /* c_avl_node_t *c_avl_node_prev */
-
-static int _remove(c_avl_tree_t *t, c_avl_node_t *n) {
-  assert((t != NULL) && (n != NULL));
-
-  if ((n->left != NULL) && (n->right != NULL)) {
-    c_avl_node_t *r;    /* replacement node */
-    if (BALANCE(n) > 0) /* left subtree is higher */
-    {
-      assert(n->left != NULL);
-      r = c_avl_node_prev(n);
-
-    } else /* right subtree is higher */
-    {
-      assert(n->right != NULL);
-      r = c_avl_node_next(n);
-    }
+  n->key[n->num] = p->key[i];
+  n->prefix[n->num] = p->prefix[i];
+  n->child[n->num + 1] = r->child[0];
+  n->num++;
+
+  p->key[i] = r->key[0];
+  p->prefix[i] = r->prefix[0];
+  memmove(r->key, r->key + 1, (r->num - 1) * sizeof(r->key[0]));
+  memmove(r->prefix, r->prefix + 1, (r->num - 1) * sizeof(r->prefix[0]));
+  memmove(r->child, r->child + 1, r->num * sizeof(r->child[0]));
+  r->num--;
+}
 
-    assert((r->left == NULL) || (r->right == NULL));
+/* Merges p->child[i + 1] into p->child[i] and frees it. */
+static void merge(c_avl_tree_t *t, c_avl_node_t *p, int i) {
+  c_avl_node_t *l = p->child[i];
+  c_avl_node_t *r = p->child[i + 1];
 
-    /* copy content */
-    n->key = r->key;
-    n->value = r->value;
+  if (l->leaf) {
+    memcpy(l->key + l->num, r->key, r->num * sizeof(r->key[0]));
+    memcpy(l->prefix + l->num, r->prefix, r->num * sizeof(r->prefix[0]));
+    memcpy(l->value + l->num, r->value, r->num * sizeof(r->value[0]));
+    l->num += r->num;
 
-    n = r;
+    l->next = r->next;
+    if (r->next != NULL)
+      r->next->prev = l;
+  } else {
+    l->key[l->num] = p->key[i];
+    l->prefix[l->num] = p->prefix[i];
+    memcpy(l->key + l->num + 1, r->key, r->num * sizeof(r->key[0]));
+    memcpy(l->prefix + l->num + 1, r->prefix, r->num * sizeof(r->prefix[0]));
+    memcpy(l->child + l->num + 1, r->child, (r->num + 1) * sizeof(r->child[0]));
+    l->num += r->num + 1;
   }
 
-  assert((n->left == NULL) || (n->right == NULL));
+  node_destroy(t, r);
+  node_remove_at(p, i);
+}
 
-  if ((n->left == NULL) && (n->right == NULL)) {
-    /* Deleting a leave is easy */
-    if (n->parent == NULL) {
-      assert(t->root == n);
-      t->root = NULL;
-    } else {
-      assert((n->parent->left == n) || (n->parent->right == n));
-      if (n->parent->left == n)
-        n->parent->left = NULL;
-      else
-        n->parent->right = NULL;
+/* Walks from the root to the leaf that contains (or would contain) "key",
+ * recording the path. Returns the leaf and stores the depth in "depth". */
+static c_avl_node_t *descend(c_avl_tree_t *t, const void *key, uint64_t kp,
+                             bt_path_t *path, int *depth) {
+  c_avl_node_t *n = t->root;
+
+  *depth = 0;
+  while (!n->leaf) {
+    bool found;
+    int i = node_locate(t, n, key, kp, &found);
+    if (found)
+      i++;
+
+    assert(*depth < BT_MAX_DEPTH);
+    path[*depth].node = n;
+    path[*depth].index = i;
+    (*depth)++;
+    n = n->child[i];
+  }
 
-      rebalance(t, n->parent);
-    }
+  return n;
+}
 
-    free_node(n);
-  } else if (n->left == NULL) {
-    assert(BALANCE(n) == -1);
-    assert((n->parent == NULL) || (n->parent->left == n) ||
-           (n->parent->right == n));
-    if (n->parent == NULL) {
-      assert(t->root == n);
-      t->root = n->right;
-    } else if (n->parent->left == n) {
-      n->parent->left = n->right;
-    } else {
-      n->parent->right = n->right;
+/* Removes entry "i" from "leaf" and restores the tree's invariants along the
+ * recorded path. */
+static void remove_at(c_avl_tree_t *t, bt_path_t *path, int depth,
+                      c_avl_node_t *leaf, int i) {
+  c_avl_node_t *n = leaf;
+
+  node_remove_at(leaf, i);
+
+  /* The leaf's smallest key is also the separator in the lowest ancestor in
+   * which the path does not take the leftmost child. */
+  if ((i == 0) && (leaf->num > 0)) {
+    for (int d = depth - 1; d >= 0; d--) {
+      if (path[d].index == 0)
+        continue;
+      path[d].node->key[path[d].index - 1] = leaf->key[0];
+      path[d].node->prefix[path[d].index - 1] = leaf->prefix[0];
+      break;
     }
-    n->right->parent = n->parent;
-
-    if (n->parent != NULL)
-      rebalance(t, n->parent);
-
-    n->right = NULL;
-    free_node(n);
-  } else if (n->right == NULL) {
-    assert(BALANCE(n) == 1);
-    assert((n->parent == NULL) || (n->parent->left == n) ||
-           (n->parent->right == n));
-    if (n->parent == NULL) {
-      assert(t->root == n);
-      t->root = n->left;
-    } else if (n->parent->left == n) {
-      n->parent->left = n->left;
-    } else {
-      n->parent->right = n->left;
+  }
+
+  while ((depth > 0) && (n->num < BT_MIN_KEYS)) {
+    c_avl_node_t *p = path[depth - 1].node;
+    int ci = path[depth - 1].index;
+
+    if ((ci > 0) && (p->child[ci - 1]->num > BT_MIN_KEYS)) {
+      borrow_left(p, ci);
+      break;
+    } else if ((ci < p->num) && (p->child[ci + 1]->num > BT_MIN_KEYS)) {
+      borrow_right(p, ci);
+      break;
     }
-    n->left->parent = n->parent;
 
-    if (n->parent != NULL)
-      rebalance(t, n->parent);
+    if (ci > 0)
+      merge(t, p, ci - 1);
+    else
+      merge(t, p, ci);
+
+    n = p;
+    depth--;
+  }
 
-    n->left = NULL;
-    free_node(n);
-  } else {
-    assert(0);
+  n = t->root;
+  if (!n->leaf && (n->num == 0)) {
+    t->root = n->child[0];
+    node_destroy(t, n);
+  } else if (n->leaf && (n->num == 0)) {
+    t->root = NULL;
+    node_destroy(t, n);
   }
 
-  return 0;
-} /* void *_remove */
+  t->size--;
+  t->generation++;
+  verify_tree(t);
+}
+
+/* Re-finds the iterator's position after the tree has been modified. If the
+ * last returned key is gone, the position is set to just before its
+ * successor, which makes both "next" and "prev" continue correctly. */
+static void iterator_seek(c_avl_iterator_t *iter) {
+  c_avl_tree_t *t = iter->tree;
+  bt_path_t path[BT_MAX_DEPTH];
+  int depth;
+  bool found;
+
+  iter->generation = t->generation;
+  if ((iter->node == NULL) || (t->root == NULL)) {
+    iter->node = NULL;
+    return;
+  }
+
+  uint64_t kp = t->prefix ? key_prefix(iter->key) : 0;
+  iter->node = descend(t, iter->key, kp, path, &depth);
+  iter->index = node_locate(t, iter->node, iter->key, kp, &found);
+  if (!found)
+    iter->index--;
+}
 
 /*
  * public functions
@@ -427,6 +502,10 @@ c_avl_tree_t *c_avl_create(int (*compare)(const void *, const void *)) {
   t->root = NULL;
   t->compare = compare;
   t->size = 0;
+  t->prefix = (compare == (int (*)(const void *, const void *))strcmp);
+  t->generation = 0;
+  t->owner = memstats_owner_current();
+  memstats_add(t->owner, (int64_t)sizeof(*t), 1);
 
   return t;
 }
@@ -434,105 +513,138 @@ c_avl_tree_t *c_avl_create(int (*compare)(const void *, const void *)) {
 void c_avl_destroy(c_avl_tree_t *t) {
   if (t == NULL)
     return;
-  free_node(t->root);
+  free_node(t, t->root);
+  memstats_add(t->owner, -(int64_t)sizeof(*t), -1);
   free(t);
 }
 
 int c_avl_insert(c_avl_tree_t *t, void *key, void *value) {
-  c_avl_node_t *new;
-  c_avl_node_t *nptr;
-  int cmp;
-
-  if ((new = malloc(sizeof(*new))) == NULL)
-    return -1;
+  bt_path_t path[BT_MAX_DEPTH];
+  c_avl_node_t *n;
+  int depth;
+  bool found;
 
-  new->key = key;
-  new->value = value;
-  new->height = 1;
-  new->left = NULL;
-  new->right = NULL;
+  uint64_t kp = t->prefix ? key_prefix(key) : 0;
 
   if (t->root == NULL) {
-    new->parent = NULL;
-    t->root = new;
-    t->size = 1;
-    return 0;
+    if ((t->root = node_create(t, /* leaf = */ true)) == NULL)
+      return -1;
   }
 
-  nptr = t->root;
-  while (42) {
-    cmp = t->compare(nptr->key, new->key);
-    if (cmp == 0) {
-      free_node(new);
-      return 1;
-    } else if (cmp < 0) {
-      /* nptr < new */
-      if (nptr->right == NULL) {
-        nptr->right = new;
-        new->parent = nptr;
-        rebalance(t, nptr);
-        break;
-      } else {
-        nptr = nptr->right;
-      }
-    } else /* if (cmp > 0) */
-    {
-      /* nptr > new */
-      if (nptr->left == NULL) {
-        nptr->left = new;
-        new->parent = nptr;
-        rebalance(t, nptr);
+  n = descend(t, key, kp, path, &depth);
+  int i = node_locate(t, n, key, kp, &found);
+  if (found)
+    return 1;
+
+  /* Every full node on the way up is split, and if that includes the root a
+   * new root is needed, too. Allocate all nodes up front so that a failing
+   * allocation leaves the tree untouched. */
+  c_avl_node_t *spare[BT_MAX_DEPTH + 1];
+  if (n->num == BT_MAX_KEYS) {
+    int spare_num = 0;
+    for (int d = depth; d >= 0; d--) {
+      c_avl_node_t *c = (d == depth) ? n : path[d].node;
+      if (c->num < BT_MAX_KEYS)
         break;
-      } else {
-        nptr = nptr->left;
+      spare_num++;
+    }
+    if (spare_num == depth + 1)
+      spare_num++; /* new root */
+    for (int j = 0; j < spare_num; j++) {
+      spare[j] = node_create(t, /* leaf = */ (j == 0));
+      if (spare[j] == NULL) {
+        for (int k = 0; k < j; k++)
+          node_destroy(t, spare[k]);
+        return -1;
       }
     }
-  } /* while (42) */
+  }
+
+  node_insert_at(n, i, key, kp, value);
+
+  for (int j = 0; n->num > BT_MAX_KEYS; j++) {
+    void *sep;
+    uint64_t sep_prefix;
+    c_avl_node_t *r = node_split(n, spare[j], &sep, &sep_prefix);
+
+    if (depth == 0) {
+      c_avl_node_t *root = spare[j + 1];
+      root->num = 1;
+      root->key[0] = sep;
+      root->prefix[0] = sep_prefix;
+      root->child[0] = n;
+      root->child[1] = r;
+      t->root = root;
+      break;
+    }
+
+    depth--;
+    node_insert_at(path[depth].node, path[depth].index, sep, sep_prefix, r);
+    n = path[depth].node;
+  }
 
-  verify_tree(t->root);
-  ++t->size;
+  t->size++;
+  t->generation++;
+  verify_tree(t);
   return 0;
 } /* int c_avl_insert */
 
 int c_avl_remove(c_avl_tree_t *t, const void *key, void **rkey, void **rvalue) {
+  bt_path_t path[BT_MAX_DEPTH];
   c_avl_node_t *n;
-  int status;
+  int depth;
+  bool found;
 
   assert(t != NULL);
 
-  n = search(t, key);
-  if (n == NULL)
+  if (t->root == NULL)
+    return -1;
+
+  uint64_t kp = t->prefix ? key_prefix(key) : 0;
+  n = descend(t, key, kp, path, &depth);
+  int i = node_locate(t, n, key, kp, &found);
+  if (!found)
     return -1;
 
   if (rkey != NULL)
-    *rkey = n->key;
+    *rkey = n->key[i];
   if (rvalue != NULL)
-    *rvalue = n->value;
+    *rvalue = n->value[i];
 
-  status = _remove(t, n);
-  verify_tree(t->root);
-  --t->size;
-  return status;
+  remove_at(t, path, depth, n, i);
+  return 0;
 } /* void *c_avl_remove */
 
 int c_avl_get(c_avl_tree_t *t, const void *key, void **value) {
   c_avl_node_t *n;
+  bool found;
 
   assert(t != NULL);
 
-  n = search(t, key);
-  if (n == NULL)
+  if (t->root == NULL)
+    return -1;
+
+  uint64_t kp = t->prefix ? key_prefix(key) : 0;
+  n = t->root;
+  while (!n->leaf) {
+    int i = node_locate(t, n, key, kp, &found);
+    n = n->child[found ? i + 1 : i];
+  }
+
+  int i = node_locate(t, n, key, kp, &found);
+  if (!found)
     return -1;
 
   if (value != NULL)
-    *value = n->value;
+    *value = n->value[i];
 
   return 0;
 }
 
 int c_avl_pick(c_avl_tree_t *t, void **key, void **value) {
+  bt_path_t path[BT_MAX_DEPTH];
   c_avl_node_t *n;
-  c_avl_node_t *p;
+  int depth = 0;
 
   assert(t != NULL);
 
@@ -541,37 +653,20 @@ int c_avl_pick(c_avl_tree_t *t, void **key, void **value) {
   if (t->root == NULL)
     return -1;
 
+  /* The last entry of the last leaf is the cheapest one to remove. */
   n = t->root;
-  while ((n->left != NULL) || (n->right != NULL)) {
-    if (n->left == NULL) {
-      n = n->right;
-      continue;
-    } else if (n->right == NULL) {
-      n = n->left;
-      continue;
-    }
-
-    if (n->left->height > n->right->height)
-      n = n->left;
-    else
-      n = n->right;
+  while (!n->leaf) {
+    assert(depth < BT_MAX_DEPTH);
+    path[depth].node = n;
+    path[depth].index = n->num;
+    depth++;
+    n = n->child[n->num];
   }
 
-  p = n->parent;
-  if (p == NULL)
-    t->root = NULL;
-  else if (p->left == n)
-    p->left = NULL;
-  else
-    p->right = NULL;
-
-  *key = n->key;
-  *value = n->value;
-
-  free_node(n);
-  --t->size;
-  rebalance(t, p);
+  *key = n->key[n->num - 1];
+  *value = n->value[n->num - 1];
 
+  remove_at(t, path, depth, n, n->num - 1);
   return 0;
 } /* int c_avl_pick */
 
@@ -585,56 +680,83 @@ c_avl_iterator_t *c_avl_get_iterator(c_avl_tree_t *t) {
   if (iter == NULL)
     return NULL;
   iter->tree = t;
+  iter->generation = t->generation;
 
   return iter;
 } /* c_avl_iterator_t *c_avl_get_iterator */
 
 int c_avl_iterator_next(c_avl_iterator_t *iter, void **key, void **value) {
   c_avl_node_t *n;
+  int i;
 
   if ((iter == NULL) || (key == NULL) || (value == NULL))
     return -1;
 
+  if (iter->generation != iter->tree->generation)
+    iterator_seek(iter);
+
   if (iter->node == NULL) {
-    for (n = iter->tree->root; n != NULL; n = n->left)
-      if (n->left == NULL)
-        break;
-    iter->node = n;
+    n = iter->tree->root;
+    if (n == NULL)
+      return -1;
+    while (!n->leaf)
+      n = n->child[0];
+    i = 0;
   } else {
-    n = c_avl_node_next(iter->node);
+    n = iter->node;
+    i = iter->index + 1;
+    if (i >= n->num) {
+      n = n->next;
+      i = 0;
+    }
   }
 
   if (n == NULL)
     return -1;
 
   iter->node = n;
-  *key = n->key;
-  *value = n->value;
+  iter->index = i;
+  iter->key = n->key[i];
+  *key = n->key[i];
+  *value = n->value[i];
 
   return 0;
 } /* int c_avl_iterator_next */
 
 int c_avl_iterator_prev(c_avl_iterator_t *iter, void **key, void **value) {
   c_avl_node_t *n;
+  int i;
 
   if ((iter == NULL) || (key == NULL) || (value == NULL))
     return -1;
 
+  if (iter->generation != iter->tree->generation)
+    iterator_seek(iter);
+
   if (iter->node == NULL) {
-    for (n = iter->tree->root; n != NULL; n = n->right)
-      if (n->right == NULL)
-        break;
-    iter->node = n;
+    n = iter->tree->root;
+    if (n == NULL)
+      return -1;
+    while (!n->leaf)
+      n = n->child[n->num];
+    i = n->num - 1;
   } else {
-    n = c_avl_node_prev(iter->node);
+    n = iter->node;
+    i = iter->index - 1;
+    if (i < 0) {
+      n = n->prev;
+      i = (n != NULL) ? n->num - 1 : 0;
+    }
   }
 
   if (n == NULL)
     return -1;
 
   iter->node = n;
-  *key = n->key;
-  *value = n->value;
+  iter->index = i;
+  iter->key = n->key[i];
+  *key = n->key[i];
+  *value = n->value[i];
 
   return 0;
 } /* int c_avl_iterator_prev */
@@ -38,7 +38,8 @@ typedef struct c_avl_iterator_s c_avl_iterator_t;
  *   c_avl_create
  *
  * DESCRIPTION
- *   Allocates a new AVL-tree.
+ *   Allocates a new AVL-tree. Despite the name, the tree is implemented as a
+ *   B+-tree with cache line aligned nodes of up to 16 keys each.
  *
  * PARAMETERS
  *   `compare'  The function-pointer `compare' is used to compare two keys. It
@@ -46,7 +47,9 @@ typedef struct c_avl_iterator_s c_avl_iterator_t;
  *              then the second argument, more than zero if the first argument
  *              is bigger than the second argument and zero if they are equal.
  *              If your keys are char-pointers, you can use the `strcmp'
- *              function from the libc here.
+ *              function from the libc here. Trees using `strcmp' keep the
+ *              first eight bytes of each key in the nodes and only call
+ *              `strcmp' when those are equal.
  *
  * RETURN VALUE
  *   A c_avl_tree_t-pointer upon success or NULL upon failure.
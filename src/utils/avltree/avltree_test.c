@@ -30,6 +30,8 @@
 #include "testing.h"
 #include "utils/avltree/avltree.h"
 
+#include <time.h>
+
 static int compare_total_count;
 
 #define RESET_COUNTS()                                                         \
@@ -173,8 +175,299 @@ DEF_TEST(success) {
   return 0;
 }
 
+static int int_compare(void const *a, void const *b) {
+  int ia = *(int const *)a;
+  int ib = *(int const *)b;
+  return (ia > ib) - (ia < ib);
+}
+
+static void shuffle(int *v, size_t n) {
+  for (size_t i = n - 1; i > 0; i--) {
+    size_t j = (size_t)rand() % (i + 1);
+    int tmp = v[i];
+    v[i] = v[j];
+    v[j] = tmp;
+  }
+}
+
+/* Runs enough inserts and removes to exercise node splits, borrowing from
+ * siblings, merges and shrinking the tree back to a single leaf. */
+DEF_TEST(random) {
+  enum { N = 5000 };
+  static int keys[N];
+  static bool present[N];
+  int size = 0;
+
+  srand(42);
+  for (int i = 0; i < N; i++)
+    keys[i] = i;
+
+  c_avl_tree_t *t;
+  CHECK_NOT_NULL(t = c_avl_create(int_compare));
+
+  for (int round = 0; round < 4 * N; round++) {
+    int i = rand() % N;
+    if (present[i]) {
+      void *rkey = NULL;
+      void *rvalue = NULL;
+      if (c_avl_remove(t, &keys[i], &rkey, &rvalue) != 0 ||
+          rkey != &keys[i] || rvalue != &keys[i]) {
+        OK1(0, "c_avl_remove returns the stored key and value");
+        return -1;
+      }
+      present[i] = false;
+      size--;
+    } else {
+      if (c_avl_insert(t, &keys[i], &keys[i]) != 0) {
+        OK1(0, "c_avl_insert succeeds");
+        return -1;
+      }
+      present[i] = true;
+      size++;
+    }
+  }
+  EXPECT_EQ_INT(size, c_avl_size(t));
+
+  int found = 0;
+  for (int i = 0; i < N; i++) {
+    void *value = NULL;
+    if ((c_avl_get(t, &keys[i], &value) == 0) != present[i])
+      break;
+    if (present[i] && value != &keys[i])
+      break;
+    found += present[i];
+  }
+  EXPECT_EQ_INT(size, found);
+
+  /* iterate forward and backward */
+  c_avl_iterator_t *iter;
+  int *key;
+  int *value;
+  int prev = -1;
+  int count = 0;
+  CHECK_NOT_NULL(iter = c_avl_get_iterator(t));
+  while (c_avl_iterator_next(iter, (void **)&key, (void **)&value) == 0) {
+    if (*key <= prev || !present[*key])
+      break;
+    prev = *key;
+    count++;
+  }
+  EXPECT_EQ_INT(size, count);
+  /* stepping back from the end returns the second to last entry */
+  CHECK_ZERO(c_avl_iterator_prev(iter, (void **)&key, (void **)&value));
+  OK(*key < prev);
+  c_avl_iterator_destroy(iter);
+
+  prev = N;
+  count = 0;
+  CHECK_NOT_NULL(iter = c_avl_get_iterator(t));
+  while (c_avl_iterator_prev(iter, (void **)&key, (void **)&value) == 0) {
+    if (*key >= prev || !present[*key])
+      break;
+    prev = *key;
+    count++;
+  }
+  EXPECT_EQ_INT(size, count);
+  c_avl_iterator_destroy(iter);
+
+  /* pick everything */
+  while (c_avl_pick(t, (void **)&key, (void **)&value) == 0) {
+    if (!present[*key])
+      break;
+    present[*key] = false;
+    size--;
+  }
+  EXPECT_EQ_INT(0, size);
+  EXPECT_EQ_INT(0, c_avl_size(t));
+
+  c_avl_destroy(t);
+  return 0;
+}
+
+static int strcmp_qsort(void const *a, void const *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Trees using strcmp() compare cached key prefixes first. */
+DEF_TEST(string_prefix) {
+  char *cases[] = {
+      "",
+      "a",
+      "ab",
+      "abcdefg",
+      "abcdefgh",
+      "abcdefghi",
+      "abcdefgh0",
+      "abcdefgg",
+      "host.example.com/cpu-0/cpu-idle",
+      "host.example.com/cpu-0/cpu-user",
+      "host.example.com/cpu-1/cpu-idle",
+      "host.example.com/cpu-10/cpu-idle",
+      "host.example.org/cpu-0/cpu-idle",
+      "\xc3\xa4pfel",
+      "z",
+      "zzzzzzzzzzzzzzzzzzzz",
+  };
+  char *sorted[STATIC_ARRAY_SIZE(cases)];
+  memcpy(sorted, cases, sizeof(cases));
+  qsort(sorted, STATIC_ARRAY_SIZE(sorted), sizeof(sorted[0]), strcmp_qsort);
+
+  c_avl_tree_t *t;
+  CHECK_NOT_NULL(
+      t = c_avl_create((int (*)(const void *, const void *))strcmp));
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++)
+    CHECK_ZERO(c_avl_insert(t, cases[i], cases[i]));
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++)
+    EXPECT_EQ_INT(1, c_avl_insert(t, cases[i], cases[i]));
+
+  /* lookups with a copy of the key, i.e. a different pointer */
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    char buffer[64];
+    char *value = NULL;
+    snprintf(buffer, sizeof(buffer), "%s", cases[i]);
+    CHECK_ZERO(c_avl_get(t, buffer, (void *)&value));
+    EXPECT_EQ_PTR(cases[i], value);
+  }
+  OK(c_avl_get(t, "abcdefgh1", NULL) != 0);
+  OK(c_avl_get(t, "abc", NULL) != 0);
+
+  c_avl_iterator_t *iter;
+  char *key;
+  char *value;
+  size_t i = 0;
+  CHECK_NOT_NULL(iter = c_avl_get_iterator(t));
+  while (c_avl_iterator_next(iter, (void **)&key, (void **)&value) == 0) {
+    EXPECT_EQ_STR(sorted[i], key);
+    i++;
+  }
+  c_avl_iterator_destroy(iter);
+  EXPECT_EQ_INT(STATIC_ARRAY_SIZE(cases), i);
+
+  c_avl_destroy(t);
+  return 0;
+}
+
+/* Inserting while iterating must neither skip nor repeat existing keys, even
+ * though leaves are split underneath the iterator. */
+DEF_TEST(iterator_insert) {
+  enum { N = 200 };
+  static int keys[2 * N];
+
+  c_avl_tree_t *t;
+  CHECK_NOT_NULL(t = c_avl_create(int_compare));
+  for (int i = 0; i < 2 * N; i++)
+    keys[i] = i;
+  for (int i = 0; i < N; i++)
+    CHECK_ZERO(c_avl_insert(t, &keys[2 * i], NULL));
+
+  c_avl_iterator_t *iter;
+  int *key;
+  void *value;
+  int expect = 0;
+  CHECK_NOT_NULL(iter = c_avl_get_iterator(t));
+  while (c_avl_iterator_next(iter, (void **)&key, &value) == 0) {
+    if (*key != expect)
+      break;
+    /* odd keys sort before the next even key and are visited, too */
+    if ((*key % 2) == 0)
+      CHECK_ZERO(c_avl_insert(t, &keys[*key + 1], NULL));
+    expect++;
+  }
+  c_avl_iterator_destroy(iter);
+  EXPECT_EQ_INT(2 * N, expect);
+
+  c_avl_destroy(t);
+  return 0;
+}
+
+static double time_diff(struct timespec const *begin,
+                        struct timespec const *end) {
+  return (double)(end->tv_sec - begin->tv_sec) * 1e9 +
+         (double)(end->tv_nsec - begin->tv_nsec);
+}
+
+#define BENCHMARK(name, n, code)                                               \
+  do {                                                                         \
+    struct timespec begin__, end__;                                            \
+    clock_gettime(CLOCK_MONOTONIC, &begin__);                                  \
+    code;                                                                      \
+    clock_gettime(CLOCK_MONOTONIC, &end__);                                    \
+    printf("# %-8s %8.1f ns/op\n", name,                                       \
+           time_diff(&begin__, &end__) / (double)(n));                         \
+  } while (0)
+
+/* Not a correctness test as such: reports the cost of the basic operations
+ * on a tree with string keys, the most common use in collectd. */
+DEF_TEST(benchmark) {
+  enum { N = 100000 };
+  char **keys;
+  int *order;
+
+  CHECK_NOT_NULL(keys = calloc(N, sizeof(*keys)));
+  CHECK_NOT_NULL(order = calloc(N, sizeof(*order)));
+  for (int i = 0; i < N; i++) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "host%03d.example.com/cpu-%d/cpu-idle",
+             i / 64, i % 64);
+    CHECK_NOT_NULL(keys[i] = strdup(buffer));
+    order[i] = i;
+  }
+  srand(1);
+  shuffle(order, N);
+
+  c_avl_tree_t *t;
+  CHECK_NOT_NULL(
+      t = c_avl_create((int (*)(const void *, const void *))strcmp));
+
+  int status = 0;
+  BENCHMARK("insert", N, {
+    for (int i = 0; i < N; i++)
+      status |= c_avl_insert(t, keys[order[i]], keys[order[i]]);
+  });
+  EXPECT_EQ_INT(0, status);
+  EXPECT_EQ_INT(N, c_avl_size(t));
+
+  shuffle(order, N);
+  BENCHMARK("get", N, {
+    for (int i = 0; i < N; i++)
+      status |= c_avl_get(t, keys[order[i]], NULL);
+  });
+  EXPECT_EQ_INT(0, status);
+
+  int count = 0;
+  BENCHMARK("iterate", N, {
+    c_avl_iterator_t *iter = c_avl_get_iterator(t);
+    void *key;
+    void *value;
+    while (c_avl_iterator_next(iter, &key, &value) == 0)
+      count++;
+    c_avl_iterator_destroy(iter);
+  });
+  EXPECT_EQ_INT(N, count);
+
+  shuffle(order, N);
+  BENCHMARK("remove", N, {
+    for (int i = 0; i < N; i++)
+      status |= c_avl_remove(t, keys[order[i]], NULL, NULL);
+  });
+  EXPECT_EQ_INT(0, status);
+  EXPECT_EQ_INT(0, c_avl_size(t));
+
+  c_avl_destroy(t);
+  for (int i = 0; i < N; i++)
+    free(keys[i]);
+  free(keys);
+  free(order);
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(success);
+  RUN_TEST(random);
+  RUN_TEST(string_prefix);
+  RUN_TEST(iterator_insert);
+  RUN_TEST(benchmark);
 
   END_TEST;
 }
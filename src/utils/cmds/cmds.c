@@ -28,7 +28,9 @@
 
 #include "utils/cmds/cmds.h"
 #include "utils/cmds/flush.h"
+#include "utils/cmds/gethistory.h"
 #include "utils/cmds/getval.h"
+#include "utils/cmds/getvals.h"
 #include "utils/cmds/listval.h"
 #include "utils/cmds/parse_option.h"
 #include "utils/cmds/putval.h"
@@ -204,9 +206,18 @@ cmd_status_t cmd_parsev(size_t argc, char **argv, cmd_t *ret_cmd,
     ret_cmd->type = CMD_GETVAL;
     status =
         cmd_parse_getval(argc - 1, argv + 1, &ret_cmd->cmd.getval, opts, err);
+  } else if (strcasecmp("GETHISTORY", command) == 0) {
+    ret_cmd->type = CMD_GETHISTORY;
+    status = cmd_parse_gethistory(argc - 1, argv + 1,
+                                  &ret_cmd->cmd.gethistory, opts, err);
   } else if (strcasecmp("LISTVAL", command) == 0) {
     ret_cmd->type = CMD_LISTVAL;
-    status = cmd_parse_listval(argc - 1, argv + 1, opts, err);
+    status = cmd_parse_listval(argc - 1, argv + 1, &ret_cmd->cmd.listval, opts,
+                               err);
+  } else if (strcasecmp("GETVALS", command) == 0) {
+    ret_cmd->type = CMD_GETVALS;
+    status =
+        cmd_parse_getvals(argc - 1, argv + 1, &ret_cmd->cmd.getvals, opts, err);
   } else if (strcasecmp("PUTVAL", command) == 0) {
     ret_cmd->type = CMD_PUTVAL;
     status =
@@ -250,7 +261,14 @@ void cmd_destroy(cmd_t *cmd) {
   case CMD_GETVAL:
     cmd_destroy_getval(&cmd->cmd.getval);
     break;
+  case CMD_GETHISTORY:
+    cmd_destroy_gethistory(&cmd->cmd.gethistory);
+    break;
   case CMD_LISTVAL:
+    cmd_destroy_listval(&cmd->cmd.listval);
+    break;
+  case CMD_GETVALS:
+    cmd_destroy_getvals(&cmd->cmd.getvals);
     break;
   case CMD_PUTVAL:
     cmd_destroy_putval(&cmd->cmd.putval);
@@ -37,6 +37,8 @@ typedef enum {
   CMD_GETVAL = 2,
   CMD_LISTVAL = 3,
   CMD_PUTVAL = 4,
+  CMD_GETHISTORY = 5,
+  CMD_GETVALS = 6,
 } cmd_type_t;
 #define CMD_TO_STRING(type)                                                    \
   ((type) == CMD_FLUSH)                                                        \
@@ -45,7 +47,12 @@ typedef enum {
             ? "GETVAL"                                                         \
             : ((type) == CMD_LISTVAL)                                          \
                   ? "LISTVAL"                                                  \
-                  : ((type) == CMD_PUTVAL) ? "PUTVAL" : "UNKNOWN"
+                  : ((type) == CMD_PUTVAL)                                     \
+                        ? "PUTVAL"                                             \
+                        : ((type) == CMD_GETHISTORY)                           \
+                              ? "GETHISTORY"                                   \
+                              : ((type) == CMD_GETVALS) ? "GETVALS"            \
+                                                        : "UNKNOWN"
 
 typedef struct {
   double timeout;
@@ -61,6 +68,30 @@ typedef struct {
   identifier_t identifier;
 } cmd_getval_t;
 
+typedef struct {
+  char *raw_identifier;
+  identifier_t identifier;
+  /* Maximum number of samples to return, zero means all. */
+  size_t num;
+} cmd_gethistory_t;
+
+/* Selects cache entries by their name. NULL members match everything. */
+typedef struct {
+  char *prefix;
+  char *glob;
+} cmd_name_filter_t;
+
+typedef struct {
+  cmd_name_filter_t filter;
+} cmd_listval_t;
+
+typedef struct {
+  /* Either a list of identifiers or a filter selecting the value lists. */
+  char **identifiers;
+  size_t identifiers_num;
+  cmd_name_filter_t filter;
+} cmd_getvals_t;
+
 typedef struct {
   /* The raw identifier as provided by the user. */
   char *raw_identifier;
@@ -83,7 +114,10 @@ typedef struct {
   union {
     cmd_flush_t flush;
     cmd_getval_t getval;
+    cmd_gethistory_t gethistory;
     cmd_putval_t putval;
+    cmd_listval_t listval;
+    cmd_getvals_t getvals;
   } cmd;
 } cmd_t;
 
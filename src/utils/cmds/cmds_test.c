@@ -32,6 +32,8 @@
 #include "utils/common/common.h"
 #include "testing.h"
 #include "utils/cmds/cmds.h"
+#include "utils/cmds/listval.h"
+#include "utils/cmds/putval.h"
 // clang-format on
 
 static void error_cb(void *ud, cmd_status_t status, const char *format,
@@ -151,6 +153,40 @@ static struct {
         CMD_UNKNOWN,
     },
 
+    /* Valid GETHISTORY commands. */
+    {
+        "GETHISTORY myhost/magic/MAGIC",
+        NULL,
+        CMD_OK,
+        CMD_GETHISTORY,
+    },
+    {
+        "GETHISTORY magic/MAGIC num=10",
+        &default_host_opts,
+        CMD_OK,
+        CMD_GETHISTORY,
+    },
+
+    /* Invalid GETHISTORY commands. */
+    {
+        "GETHISTORY",
+        NULL,
+        CMD_PARSE_ERROR,
+        CMD_UNKNOWN,
+    },
+    {
+        "GETHISTORY myhost/magic/MAGIC num=ten",
+        NULL,
+        CMD_PARSE_ERROR,
+        CMD_UNKNOWN,
+    },
+    {
+        "GETHISTORY myhost/magic/MAGIC invalid=option",
+        NULL,
+        CMD_PARSE_ERROR,
+        CMD_UNKNOWN,
+    },
+
     /* Valid LISTVAL commands. */
     {
         "LISTVAL",
@@ -158,6 +194,12 @@ static struct {
         CMD_OK,
         CMD_LISTVAL,
     },
+    {
+        "LISTVAL prefix=myhost/ glob=\"*/cpu-*\"",
+        NULL,
+        CMD_OK,
+        CMD_LISTVAL,
+    },
 
     /* Invalid LISTVAL commands. */
     {
@@ -166,6 +208,53 @@ static struct {
         CMD_PARSE_ERROR,
         CMD_UNKNOWN,
     },
+    {
+        "LISTVAL invalid=option",
+        NULL,
+        CMD_PARSE_ERROR,
+        CMD_UNKNOWN,
+    },
+
+    /* Valid GETVALS commands. */
+    {
+        "GETVALS myhost/magic/MAGIC myhost/magic/MAGIC-instance",
+        NULL,
+        CMD_OK,
+        CMD_GETVALS,
+    },
+    {
+        "GETVALS magic/MAGIC",
+        &default_host_opts,
+        CMD_OK,
+        CMD_GETVALS,
+    },
+    {
+        "GETVALS glob=myhost/*",
+        NULL,
+        CMD_OK,
+        CMD_GETVALS,
+    },
+
+    /* Invalid GETVALS commands. */
+    {
+        "GETVALS",
+        NULL,
+        CMD_PARSE_ERROR,
+        CMD_UNKNOWN,
+    },
+    {
+        "GETVALS invalid",
+        NULL,
+        CMD_PARSE_ERROR,
+        CMD_UNKNOWN,
+    },
+    {
+        /* Identifiers and filters are exclusive. */
+        "GETVALS myhost/magic/MAGIC prefix=myhost/",
+        NULL,
+        CMD_PARSE_ERROR,
+        CMD_UNKNOWN,
+    },
 
     /* Valid PUTVAL commands. */
     {
@@ -330,7 +419,90 @@ DEF_TEST(parse) {
   return test_result;
 }
 
+static struct {
+  char *input;
+  bool want_fast;
+} putval_fast_data[] = {
+    {"PUTVAL myhost/magic/MAGIC 1234:42", true},
+    {"PUTVAL \"myhost/magic/MAGIC\" interval=2 1234:42 2345:-23", true},
+    {"PUTVAL myhost/magic/MAGIC interval=2 1234:42 interval=5 2345:23", true},
+    {"putval  myhost/magic-inst/MAGIC-ti\t1234.5:+17 ", true},
+    /* Cached identifier. */
+    {"PUTVAL myhost/magic/MAGIC 1234:42", true},
+    /* Left to cmd_parse(). */
+    {"PUTVAL myhost/magic/MAGIC meta:KEY=\"string_value\" 1234:42", false},
+    {"PUTVAL myhost/magic/MAGIC 1234:0x10", false},
+    {"PUTVAL myhost/magic/MAGIC 1234:010", false},
+    {"PUTVAL myhost/magic/MAGIC 1234:42:23", false},
+    {"PUTVAL myhost/magic/MAGIC 0:42", false},
+    {"PUTVAL myhost/magic/MAGIC 1234:U", false},
+    {"PUTVAL myhost/magic/MAGIC", false},
+    {"PUTVAL magic/MAGIC N:42", false},
+    {"PUTVAL myhost/magic/UNKNOWN 1234:42", false},
+    {"PUTVAL myhost/magic/MAGIC \"\"", false},
+};
+
+DEF_TEST(putval_fast) {
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(putval_fast_data); i++) {
+    cmd_putval_fast_t fast;
+    bool got = cmd_parse_putval_fast(putval_fast_data[i].input, &fast);
+
+    printf("## cmd_parse_putval_fast (\"%s\")\n", putval_fast_data[i].input);
+    EXPECT_EQ_INT(putval_fast_data[i].want_fast, got);
+    if (!got)
+      continue;
+
+    /* The result must be identical to that of the slow path. */
+    char *input = strdup(putval_fast_data[i].input);
+    cmd_t cmd = {0};
+    EXPECT_EQ_INT(CMD_OK, cmd_parse(input, &cmd, NULL, NULL));
+    EXPECT_EQ_INT(CMD_PUTVAL, cmd.type);
+    EXPECT_EQ_INT(cmd.cmd.putval.vl_num, fast.vl_num);
+
+    for (size_t j = 0; j < fast.vl_num; j++) {
+      value_list_t *want = cmd.cmd.putval.vl + j;
+      value_list_t *vl = fast.vl + j;
+
+      EXPECT_EQ_STR(want->host, vl->host);
+      EXPECT_EQ_STR(want->plugin, vl->plugin);
+      EXPECT_EQ_STR(want->plugin_instance, vl->plugin_instance);
+      EXPECT_EQ_STR(want->type, vl->type);
+      EXPECT_EQ_STR(want->type_instance, vl->type_instance);
+      EXPECT_EQ_UINT64(want->time, vl->time);
+      EXPECT_EQ_UINT64(want->interval, vl->interval);
+      EXPECT_EQ_INT(want->values_len, vl->values_len);
+      EXPECT_EQ_INT(want->values[0].derive, vl->values[0].derive);
+    }
+
+    cmd_destroy(&cmd);
+    free(input);
+  }
+
+  return 0;
+}
+
+DEF_TEST(name_filter) {
+  cmd_name_filter_t filter = {0};
+
+  EXPECT_EQ_INT(true, cmd_name_filter_match(&filter, "myhost/cpu-0/cpu-idle"));
+
+  filter.prefix = "myhost/";
+  EXPECT_EQ_INT(true, cmd_name_filter_match(&filter, "myhost/cpu-0/cpu-idle"));
+  EXPECT_EQ_INT(false, cmd_name_filter_match(&filter, "other/cpu-0/cpu-idle"));
+
+  filter.glob = "*/cpu-*/cpu-idle";
+  EXPECT_EQ_INT(true, cmd_name_filter_match(&filter, "myhost/cpu-0/cpu-idle"));
+  EXPECT_EQ_INT(false, cmd_name_filter_match(&filter, "myhost/cpu-0/cpu-user"));
+
+  filter.prefix = NULL;
+  EXPECT_EQ_INT(true, cmd_name_filter_match(&filter, "other/cpu-1/cpu-idle"));
+
+  return 0;
+}
+
 int main(int argc, char **argv) {
   RUN_TEST(parse);
+  RUN_TEST(putval_fast);
+  RUN_TEST(name_filter);
   END_TEST;
 }
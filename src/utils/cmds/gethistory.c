@@ -0,0 +1,195 @@
+/**
+ * collectd - src/utils/cmds/gethistory.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils/common/common.h"
+
+#include "utils/cmds/gethistory.h"
+#include "utils/cmds/parse_option.h"
+#include "utils_cache.h"
+
+cmd_status_t cmd_parse_gethistory(size_t argc, char **argv,
+                                  cmd_gethistory_t *ret_gethistory,
+                                  const cmd_options_t *opts,
+                                  cmd_error_handler_t *err) {
+  char *identifier_copy;
+  int status;
+
+  if ((ret_gethistory == NULL) || (opts == NULL)) {
+    errno = EINVAL;
+    cmd_error(CMD_ERROR, err, "Invalid arguments to cmd_parse_gethistory.");
+    return CMD_ERROR;
+  }
+
+  if (argc < 1) {
+    cmd_error(CMD_PARSE_ERROR, err, "Missing identifier.");
+    return CMD_PARSE_ERROR;
+  }
+
+  for (size_t i = 1; i < argc; i++) {
+    char *opt_key = NULL;
+    char *opt_value = NULL;
+
+    status = cmd_parse_option(argv[i], &opt_key, &opt_value, err);
+    if (status != 0) {
+      if (status == CMD_NO_OPTION)
+        cmd_error(CMD_PARSE_ERROR, err, "Invalid option string `%s'.", argv[i]);
+      return CMD_PARSE_ERROR;
+    }
+
+    if (strcasecmp("num", opt_key) == 0) {
+      char *endptr = NULL;
+
+      errno = 0;
+      unsigned long long num = strtoull(opt_value, &endptr, 10);
+      if ((endptr == opt_value) || (*endptr != 0) || (errno != 0)) {
+        cmd_error(CMD_PARSE_ERROR, err, "Invalid value for option `num': %s",
+                  opt_value);
+        return CMD_PARSE_ERROR;
+      }
+      ret_gethistory->num = (size_t)num;
+    } else {
+      cmd_error(CMD_PARSE_ERROR, err, "Cannot parse option `%s'.", opt_key);
+      return CMD_PARSE_ERROR;
+    }
+  }
+
+  /* parse_identifier() modifies its first argument,
+   * returning pointers into it */
+  identifier_copy = sstrdup(argv[0]);
+
+  status = parse_identifier(argv[0], &ret_gethistory->identifier.host,
+                            &ret_gethistory->identifier.plugin,
+                            &ret_gethistory->identifier.plugin_instance,
+                            &ret_gethistory->identifier.type,
+                            &ret_gethistory->identifier.type_instance,
+                            opts->identifier_default_host);
+  if (status != 0) {
+    DEBUG("cmd_parse_gethistory: Cannot parse identifier `%s'.",
+          identifier_copy);
+    cmd_error(CMD_PARSE_ERROR, err, "Cannot parse identifier `%s'.",
+              identifier_copy);
+    sfree(identifier_copy);
+    return CMD_PARSE_ERROR;
+  }
+
+  ret_gethistory->raw_identifier = identifier_copy;
+  return CMD_OK;
+} /* cmd_status_t cmd_parse_gethistory */
+
+#define print_to_socket(fh, ...)                                               \
+  do {                                                                         \
+    if (fprintf(fh, __VA_ARGS__) < 0) {                                        \
+      WARNING("cmd_handle_gethistory: failed to write to socket #%i: %s",      \
+              fileno(fh), STRERRNO);                                           \
+      sfree(times);                                                            \
+      sfree(rates);                                                            \
+      return -1;                                                               \
+    }                                                                          \
+  } while (0)
+
+cmd_status_t cmd_handle_gethistory(FILE *fh, char *buffer) {
+  cmd_error_handler_t err = {cmd_error_fh, fh};
+  cmd_status_t status;
+  cmd_t cmd;
+
+  cdtime_t *times = NULL;
+  gauge_t *rates = NULL;
+  size_t num = 0;
+  size_t values_num = 0;
+
+  const data_set_t *ds;
+
+  if ((fh == NULL) || (buffer == NULL))
+    return -1;
+
+  DEBUG("utils_cmd_gethistory: cmd_handle_gethistory (fh = %p, buffer = %s);",
+        (void *)fh, buffer);
+
+  if ((status = cmd_parse(buffer, &cmd, NULL, &err)) != CMD_OK)
+    return status;
+  if (cmd.type != CMD_GETHISTORY) {
+    cmd_error(CMD_UNKNOWN_COMMAND, &err, "Unexpected command: `%s'.",
+              CMD_TO_STRING(cmd.type));
+    cmd_destroy(&cmd);
+    return CMD_UNKNOWN_COMMAND;
+  }
+
+  ds = plugin_get_ds(cmd.cmd.gethistory.identifier.type);
+  if (ds == NULL) {
+    DEBUG("cmd_handle_gethistory: plugin_get_ds (%s) == NULL;",
+          cmd.cmd.gethistory.identifier.type);
+    cmd_error(CMD_ERROR, &err, "Type `%s' is unknown.\n",
+              cmd.cmd.gethistory.identifier.type);
+    cmd_destroy(&cmd);
+    return -1;
+  }
+
+  status = uc_get_history_window_by_name(
+      cmd.cmd.gethistory.raw_identifier, cmd.cmd.gethistory.num, &times, &rates,
+      /* ret_values = */ NULL, &num, &values_num);
+  cmd_destroy(&cmd);
+  if (status != 0) {
+    cmd_error(CMD_ERROR, &err, "No such value.");
+    return CMD_ERROR;
+  }
+
+  if (ds->ds_num != values_num) {
+    ERROR("ds[%s]->ds_num = %" PRIsz ", "
+          "but uc_get_history_window_by_name returned %" PRIsz " values.",
+          ds->type, ds->ds_num, values_num);
+    cmd_error(CMD_ERROR, &err, "Error reading value from cache.");
+    sfree(times);
+    sfree(rates);
+    return CMD_ERROR;
+  }
+
+  print_to_socket(fh, "%" PRIsz " Sample%s found\n", num,
+                  (num == 1) ? "" : "s");
+  for (size_t i = 0; i < num; i++) {
+    print_to_socket(fh, "%.3f", CDTIME_T_TO_DOUBLE(times[i]));
+    for (size_t j = 0; j < values_num; j++) {
+      gauge_t rate = rates[i * values_num + j];
+      if (isnan(rate))
+        print_to_socket(fh, " %s=NaN", ds->ds[j].name);
+      else
+        print_to_socket(fh, " %s=%e", ds->ds[j].name, rate);
+    }
+    print_to_socket(fh, "\n");
+  }
+  fflush(fh);
+
+  sfree(times);
+  sfree(rates);
+
+  return CMD_OK;
+} /* cmd_status_t cmd_handle_gethistory */
+
+void cmd_destroy_gethistory(cmd_gethistory_t *gethistory) {
+  if (gethistory == NULL)
+    return;
+
+  sfree(gethistory->raw_identifier);
+} /* void cmd_destroy_gethistory */
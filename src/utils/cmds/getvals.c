@@ -0,0 +1,230 @@
+/**
+ * collectd - src/utils/cmds/getvals.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils/common/common.h"
+
+#include "utils/cmds/getvals.h"
+#include "utils/cmds/listval.h"
+#include "utils/cmds/parse_option.h"
+#include "utils_cache.h"
+
+cmd_status_t cmd_parse_getvals(size_t argc, char **argv,
+                               cmd_getvals_t *ret_getvals,
+                               const cmd_options_t *opts,
+                               cmd_error_handler_t *err) {
+  if ((ret_getvals == NULL) || (opts == NULL)) {
+    errno = EINVAL;
+    cmd_error(CMD_ERROR, err, "Invalid arguments to cmd_parse_getvals.");
+    return CMD_ERROR;
+  }
+
+  if (argc < 1) {
+    cmd_error(CMD_PARSE_ERROR, err, "Missing identifier or filter.");
+    return CMD_PARSE_ERROR;
+  }
+
+  for (size_t i = 0; i < argc; i++) {
+    if (strchr(argv[i], '=') != NULL) {
+      cmd_status_t status =
+          cmd_parse_name_filter(argv[i], &ret_getvals->filter, err);
+      if (status != CMD_OK) {
+        cmd_destroy_getvals(ret_getvals);
+        return status;
+      }
+      continue;
+    }
+
+    identifier_t ident;
+    char *identifier_copy = sstrdup(argv[i]);
+    if (parse_identifier(argv[i], &ident.host, &ident.plugin,
+                         &ident.plugin_instance, &ident.type,
+                         &ident.type_instance,
+                         opts->identifier_default_host) != 0) {
+      cmd_error(CMD_PARSE_ERROR, err, "Cannot parse identifier `%s'.",
+                identifier_copy);
+      sfree(identifier_copy);
+      cmd_destroy_getvals(ret_getvals);
+      return CMD_PARSE_ERROR;
+    }
+
+    /* Store the canonical name, as used by the cache. */
+    char name[6 * DATA_MAX_NAME_LEN];
+    if (format_name(name, sizeof(name), ident.host, ident.plugin,
+                    ident.plugin_instance, ident.type,
+                    ident.type_instance) != 0) {
+      cmd_error(CMD_PARSE_ERROR, err, "Identifier too long: `%s'.",
+                identifier_copy);
+      sfree(identifier_copy);
+      cmd_destroy_getvals(ret_getvals);
+      return CMD_PARSE_ERROR;
+    }
+    sfree(identifier_copy);
+
+    if (strarray_add(&ret_getvals->identifiers, &ret_getvals->identifiers_num,
+                     name) != 0) {
+      cmd_error(CMD_ERROR, err, "strarray_add failed.");
+      cmd_destroy_getvals(ret_getvals);
+      return CMD_ERROR;
+    }
+  }
+
+  if ((ret_getvals->identifiers_num > 0) &&
+      ((ret_getvals->filter.prefix != NULL) ||
+       (ret_getvals->filter.glob != NULL))) {
+    cmd_error(CMD_PARSE_ERROR, err,
+              "Identifiers and filters cannot be combined.");
+    cmd_destroy_getvals(ret_getvals);
+    return CMD_PARSE_ERROR;
+  }
+
+  return CMD_OK;
+} /* cmd_status_t cmd_parse_getvals */
+
+void cmd_destroy_getvals(cmd_getvals_t *getvals) {
+  if (getvals == NULL)
+    return;
+
+  strarray_free(getvals->identifiers, getvals->identifiers_num);
+  getvals->identifiers = NULL;
+  getvals->identifiers_num = 0;
+  cmd_destroy_name_filter(&getvals->filter);
+} /* void cmd_destroy_getvals */
+
+/* Writes "<identifier> <ds>=<value> [<ds>=<value> ...]". Values that are not
+ * available (any more) are printed as NaN. */
+static int getvals_print(FILE *fh, const char *name) /* {{{ */
+{
+  char buffer[6 * DATA_MAX_NAME_LEN];
+  char *host, *plugin, *plugin_instance, *type, *type_instance;
+
+  sstrncpy(buffer, name, sizeof(buffer));
+  if (parse_identifier(buffer, &host, &plugin, &plugin_instance, &type,
+                       &type_instance, /* default_host = */ NULL) != 0)
+    return fprintf(fh, "%s\n", name) < 0 ? -1 : 0;
+
+  const data_set_t *ds = plugin_get_ds(type);
+  if (ds == NULL)
+    return fprintf(fh, "%s\n", name) < 0 ? -1 : 0;
+
+  gauge_t *values = NULL;
+  size_t values_num = 0;
+  if ((uc_get_rate_by_name(name, &values, &values_num) != 0) ||
+      (values_num != ds->ds_num)) {
+    sfree(values);
+    values_num = 0;
+  }
+
+  if (fputs(name, fh) < 0) {
+    sfree(values);
+    return -1;
+  }
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    int status;
+    if ((i >= values_num) || isnan(values[i]))
+      status = fprintf(fh, " %s=NaN", ds->ds[i].name);
+    else
+      status = fprintf(fh, " %s=%12e", ds->ds[i].name, values[i]);
+    if (status < 0) {
+      sfree(values);
+      return -1;
+    }
+  }
+  sfree(values);
+
+  return fputc('\n', fh) == EOF ? -1 : 0;
+} /* }}} int getvals_print */
+
+cmd_status_t cmd_handle_getvals(FILE *fh, char *buffer) {
+  cmd_error_handler_t err = {cmd_error_fh, fh};
+  cmd_status_t status;
+  cmd_t cmd;
+
+  if ((fh == NULL) || (buffer == NULL))
+    return -1;
+
+  DEBUG("utils_cmd_getvals: cmd_handle_getvals (fh = %p, buffer = %s);",
+        (void *)fh, buffer);
+
+  if ((status = cmd_parse(buffer, &cmd, NULL, &err)) != CMD_OK)
+    return status;
+  if (cmd.type != CMD_GETVALS) {
+    cmd_error(CMD_UNKNOWN_COMMAND, &err, "Unexpected command: `%s'.",
+              CMD_TO_STRING(cmd.type));
+    cmd_destroy(&cmd);
+    return CMD_UNKNOWN_COMMAND;
+  }
+
+  cmd_getvals_t *getvals = &cmd.cmd.getvals;
+  status = CMD_OK;
+
+  if (getvals->identifiers_num > 0) {
+    if (fprintf(fh, "%" PRIsz " Value list%s found\n", getvals->identifiers_num,
+                (getvals->identifiers_num == 1) ? "" : "s") < 0)
+      status = CMD_ERROR;
+    for (size_t i = 0; (status == CMD_OK) && (i < getvals->identifiers_num);
+         i++) {
+      if (getvals_print(fh, getvals->identifiers[i]) != 0)
+        status = CMD_ERROR;
+    }
+  } else {
+    uc_snapshot_t *snap = uc_snapshot_acquire();
+    if (snap == NULL) {
+      cmd_error(CMD_ERROR, &err, "uc_snapshot_acquire failed.");
+      cmd_destroy(&cmd);
+      return CMD_ERROR;
+    }
+
+    size_t number = 0;
+    size_t *indices = cmd_name_filter_select(&getvals->filter, snap, &number);
+    if ((indices == NULL) && (uc_snapshot_size(snap) > 0)) {
+      cmd_error(CMD_ERROR, &err, "calloc failed.");
+      uc_snapshot_release(snap);
+      cmd_destroy(&cmd);
+      return CMD_ERROR;
+    }
+
+    if (fprintf(fh, "%" PRIsz " Value list%s found\n", number,
+                (number == 1) ? "" : "s") < 0)
+      status = CMD_ERROR;
+    for (size_t i = 0; (status == CMD_OK) && (i < number); i++) {
+      uc_snapshot_entry_t entry = {0};
+      uc_snapshot_get(snap, indices[i], &entry);
+      if (getvals_print(fh, entry.name) != 0)
+        status = CMD_ERROR;
+    }
+
+    sfree(indices);
+    uc_snapshot_release(snap);
+  }
+
+  if (status != CMD_OK)
+    WARNING("cmd_handle_getvals: failed to write to socket #%i: %s", fileno(fh),
+            STRERRNO);
+  fflush(fh);
+
+  cmd_destroy(&cmd);
+  return status;
+} /* cmd_status_t cmd_handle_getvals */
@@ -33,27 +33,119 @@
 #include "utils/cmds/parse_option.h"
 #include "utils_cache.h"
 
+#include <fnmatch.h>
+
+cmd_status_t cmd_parse_name_filter(char *field, cmd_name_filter_t *filter,
+                                   cmd_error_handler_t *err) {
+  char *key = NULL;
+  char *value = NULL;
+
+  cmd_status_t status = cmd_parse_option(field, &key, &value, err);
+  if (status != CMD_OK) {
+    if (status == CMD_NO_OPTION)
+      cmd_error(CMD_PARSE_ERROR, err, "Garbage after end of command: `%s'.",
+                field);
+    return CMD_PARSE_ERROR;
+  }
+
+  char **dest;
+  if (strcasecmp("prefix", key) == 0)
+    dest = &filter->prefix;
+  else if (strcasecmp("glob", key) == 0)
+    dest = &filter->glob;
+  else {
+    cmd_error(CMD_PARSE_ERROR, err, "Cannot parse option `%s'.", key);
+    return CMD_PARSE_ERROR;
+  }
+
+  char *tmp = strdup(value);
+  if (tmp == NULL) {
+    cmd_error(CMD_ERROR, err, "strdup failed.");
+    return CMD_ERROR;
+  }
+  sfree(*dest);
+  *dest = tmp;
+
+  return CMD_OK;
+} /* cmd_status_t cmd_parse_name_filter */
+
+bool cmd_name_filter_match(cmd_name_filter_t const *filter, const char *name) {
+  if ((filter->prefix != NULL) &&
+      (strncmp(filter->prefix, name, strlen(filter->prefix)) != 0))
+    return false;
+  if ((filter->glob != NULL) && (fnmatch(filter->glob, name, 0) != 0))
+    return false;
+  return true;
+} /* bool cmd_name_filter_match */
+
+void cmd_destroy_name_filter(cmd_name_filter_t *filter) {
+  if (filter == NULL)
+    return;
+
+  sfree(filter->prefix);
+  sfree(filter->glob);
+} /* void cmd_destroy_name_filter */
+
+size_t *cmd_name_filter_select(cmd_name_filter_t const *filter,
+                               uc_snapshot_t const *snap, size_t *ret_num) {
+  size_t size = uc_snapshot_size(snap);
+  size_t num = 0;
+
+  *ret_num = 0;
+  if (size == 0)
+    return NULL;
+
+  size_t *indices = calloc(size, sizeof(*indices));
+  if (indices == NULL)
+    return NULL;
+
+  for (size_t i = 0; i < size; i++) {
+    uc_snapshot_entry_t entry;
+    if (uc_snapshot_get(snap, i, &entry) != 0)
+      continue;
+
+    /* remove missing values when list values */
+    if (entry.state == STATE_MISSING)
+      continue;
+
+    if (cmd_name_filter_match(filter, entry.name))
+      indices[num++] = i;
+  }
+
+  *ret_num = num;
+  return indices;
+} /* size_t *cmd_name_filter_select */
+
 cmd_status_t cmd_parse_listval(size_t argc, char **argv,
+                               cmd_listval_t *ret_listval,
                                const cmd_options_t *opts
                                __attribute__((unused)),
                                cmd_error_handler_t *err) {
-  if (argc != 0) {
-    cmd_error(CMD_PARSE_ERROR, err, "Garbage after end of command: `%s'.",
-              argv[0]);
-    return CMD_PARSE_ERROR;
+  for (size_t i = 0; i < argc; i++) {
+    cmd_status_t status =
+        cmd_parse_name_filter(argv[i], &ret_listval->filter, err);
+    if (status != CMD_OK) {
+      cmd_destroy_listval(ret_listval);
+      return status;
+    }
   }
 
   return CMD_OK;
 } /* cmd_status_t cmd_parse_listval */
 
+void cmd_destroy_listval(cmd_listval_t *listval) {
+  if (listval == NULL)
+    return;
+
+  cmd_destroy_name_filter(&listval->filter);
+} /* void cmd_destroy_listval */
+
 #define free_everything_and_return(status)                                     \
   do {                                                                         \
-    for (size_t j = 0; j < number; j++) {                                      \
-      sfree(names[j]);                                                         \
-      names[j] = NULL;                                                         \
-    }                                                                          \
-    sfree(names);                                                              \
-    sfree(times);                                                              \
+    sfree(indices);                                                            \
+    if (snap != NULL)                                                          \
+      uc_snapshot_release(snap);                                               \
+    cmd_destroy(&cmd);                                                         \
     return status;                                                             \
   } while (0)
 
@@ -64,16 +156,18 @@ cmd_status_t cmd_parse_listval(size_t argc, char **argv,
               STRERRNO);                                                       \
       free_everything_and_return(CMD_ERROR);                                   \
     }                                                                          \
-    fflush(fh);                                                                \
   } while (0)
 
+/* The names are written straight from a cache snapshot, without copying them
+ * or holding any lock. The matching entries are selected first because the
+ * number of values is part of the first line. */
 cmd_status_t cmd_handle_listval(FILE *fh, char *buffer) {
   cmd_error_handler_t err = {cmd_error_fh, fh};
   cmd_status_t status;
-  cmd_t cmd;
+  cmd_t cmd = {0};
 
-  char **names = NULL;
-  cdtime_t *times = NULL;
+  uc_snapshot_t *snap = NULL;
+  size_t *indices = NULL;
   size_t number = 0;
 
   DEBUG("utils_cmd_listval: handle_listval (fh = %p, buffer = %s);", (void *)fh,
@@ -87,17 +181,27 @@ cmd_status_t cmd_handle_listval(FILE *fh, char *buffer) {
     free_everything_and_return(CMD_UNKNOWN_COMMAND);
   }
 
-  status = uc_get_names(&names, &times, &number);
-  if (status != 0) {
-    DEBUG("command listval: uc_get_names failed with status %i", status);
-    cmd_error(CMD_ERROR, &err, "uc_get_names failed.");
+  snap = uc_snapshot_acquire();
+  if (snap == NULL) {
+    cmd_error(CMD_ERROR, &err, "uc_snapshot_acquire failed.");
+    free_everything_and_return(CMD_ERROR);
+  }
+
+  indices = cmd_name_filter_select(&cmd.cmd.listval.filter, snap, &number);
+  if ((indices == NULL) && (uc_snapshot_size(snap) > 0)) {
+    cmd_error(CMD_ERROR, &err, "calloc failed.");
     free_everything_and_return(CMD_ERROR);
   }
 
   print_to_socket(fh, "%i Value%s found\n", (int)number,
                   (number == 1) ? "" : "s");
-  for (size_t i = 0; i < number; i++)
-    print_to_socket(fh, "%.3f %s\n", CDTIME_T_TO_DOUBLE(times[i]), names[i]);
+  for (size_t i = 0; i < number; i++) {
+    uc_snapshot_entry_t entry = {0};
+    uc_snapshot_get(snap, indices[i], &entry);
+    print_to_socket(fh, "%.3f %s\n", CDTIME_T_TO_DOUBLE(entry.time),
+                    entry.name);
+  }
+  fflush(fh);
 
   free_everything_and_return(CMD_OK);
 } /* cmd_status_t cmd_handle_listval */
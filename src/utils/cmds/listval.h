@@ -30,11 +30,30 @@
 #include <stdio.h>
 
 #include "utils/cmds/cmds.h"
+#include "utils_cache.h"
 
 cmd_status_t cmd_parse_listval(size_t argc, char **argv,
+                               cmd_listval_t *ret_listval,
                                const cmd_options_t *opts,
                                cmd_error_handler_t *err);
 
 cmd_status_t cmd_handle_listval(FILE *fh, char *buffer);
 
+void cmd_destroy_listval(cmd_listval_t *listval);
+
+/* Parses a "prefix=<string>" or "glob=<pattern>" option into `filter'. */
+cmd_status_t cmd_parse_name_filter(char *field, cmd_name_filter_t *filter,
+                                   cmd_error_handler_t *err);
+
+/* Returns true if `name' matches the filter. Globs use fnmatch(3). */
+bool cmd_name_filter_match(cmd_name_filter_t const *filter, const char *name);
+
+void cmd_destroy_name_filter(cmd_name_filter_t *filter);
+
+/* Returns the indices of the snapshot entries that are not missing and match
+ * the filter, storing their number in `ret_num'. Returns NULL if the snapshot
+ * is empty or on allocation failure. The array must be freed by the caller. */
+size_t *cmd_name_filter_select(cmd_name_filter_t const *filter,
+                               uc_snapshot_t const *snap, size_t *ret_num);
+
 #endif /* UTILS_CMD_LISTVAL_H */
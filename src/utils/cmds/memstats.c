@@ -0,0 +1,83 @@
+/**
+ * collectd - src/utils/cmds/memstats.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils/common/common.h"
+
+#include "utils/cmds/memstats.h"
+#include "utils/cmds/parse_option.h" /* for `parse_string' */
+#include "utils/memstats/memstats.h"
+
+#define print_to_socket(fh, ...)                                               \
+  if (fprintf(fh, __VA_ARGS__) < 0) {                                          \
+    WARNING("handle_memstats: failed to write to socket #%i: %s", fileno(fh), \
+            STRERRNO);                                                         \
+    return -1;                                                                 \
+  }
+
+int handle_memstats(FILE *fh, char *buffer) {
+  char *command = NULL;
+
+  if ((fh == NULL) || (buffer == NULL))
+    return -1;
+
+  DEBUG("utils_cmd_memstats: handle_memstats (fh = %p, buffer = %s);",
+        (void *)fh, buffer);
+
+  if (parse_string(&buffer, &command) != 0) {
+    print_to_socket(fh, "-1 Cannot parse command.\n");
+    return -1;
+  }
+  assert(command != NULL);
+
+  if (strcasecmp("MEMSTATS", command) != 0) {
+    print_to_socket(fh, "-1 Unexpected command: `%s'.\n", command);
+    return -1;
+  }
+
+  if (*buffer != 0) {
+    print_to_socket(fh, "-1 Garbage after end of command: %s\n", buffer);
+    return -1;
+  }
+
+  if (!memstats_enabled()) {
+    print_to_socket(fh, "-1 Memory accounting is disabled. "
+                        "Enable \"CollectInternalStats\" to enable it.\n");
+    return -1;
+  }
+
+  memstats_report_t report[MEMSTATS_OWNERS_MAX];
+  size_t num = memstats_read(report, STATIC_ARRAY_SIZE(report));
+  if (num > STATIC_ARRAY_SIZE(report))
+    num = STATIC_ARRAY_SIZE(report);
+
+  print_to_socket(fh, "%" PRIsz " Owner%s found\n", num,
+                  (num == 1) ? "" : "s");
+  for (size_t i = 0; i < num; i++)
+    print_to_socket(fh, "%s %" PRIi64 " %" PRIi64 "\n", report[i].name,
+                    report[i].bytes, report[i].objects);
+
+  return 0;
+} /* int handle_memstats */
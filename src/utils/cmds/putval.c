@@ -91,6 +91,313 @@ static int set_option(value_list_t *vl, const char *key, const char *value,
   return CMD_OK;
 } /* int set_option */
 
+/*
+ * Fast path
+ *
+ * PUTVAL lines from unixsock or exec clients are usually unquoted and only use
+ * the "interval" option. Those are parsed here in one pass, without modifying
+ * the input or allocating memory. The identifier is looked up in a small
+ * direct-mapped cache of recently seen identifiers, which holds the split
+ * identifier and the data set. Anything unusual makes the fast path give up,
+ * so that cmd_parse_putval() handles it and reports errors as before.
+ */
+#define PUTVAL_CACHE_SIZE 256
+
+typedef struct {
+  char *identifier;
+  size_t identifier_len;
+  value_list_t vl;
+  const data_set_t *ds;
+} putval_cache_entry_t;
+
+static putval_cache_entry_t putval_cache[PUTVAL_CACHE_SIZE];
+static pthread_mutex_t putval_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool putval_is_space(char c) { return isspace((unsigned char)c) != 0; }
+
+static bool putval_is_digit(char c) { return (c >= '0') && (c <= '9'); }
+
+/* Parses "[+-]digits[.digits][(e|E)[+-]digits]" spanning exactly [s, end).
+ * Only numbers whose value follows from a single multiplication or division
+ * of exact doubles (a mantissa of at most 2^53 and a decimal exponent of at
+ * most 22) are accepted; for those the result is the correctly rounded value
+ * strtod(3) returns. */
+static bool putval_parse_double(const char *s, const char *end, /* {{{ */
+                                double *ret) {
+  static const double powers[] = {
+      1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  bool negative = false;
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  bool have_digits = false;
+
+  if ((s < end) && ((*s == '-') || (*s == '+'))) {
+    negative = (*s == '-');
+    s++;
+  }
+
+  for (bool fraction = false; s < end; s++) {
+    if ((*s == '.') && !fraction) {
+      fraction = true;
+      continue;
+    }
+    if (!putval_is_digit(*s))
+      break;
+
+    have_digits = true;
+    if ((mantissa == 0) && (*s == '0')) {
+      if (fraction)
+        exponent--;
+      continue;
+    }
+    if (digits >= 19)
+      return false;
+    mantissa = 10 * mantissa + (uint64_t)(*s - '0');
+    digits++;
+    if (fraction)
+      exponent--;
+  }
+  if (!have_digits)
+    return false;
+
+  if ((s < end) && ((*s == 'e') || (*s == 'E'))) {
+    bool exp_negative = false;
+    int exp_value = 0;
+
+    s++;
+    if ((s < end) && ((*s == '-') || (*s == '+'))) {
+      exp_negative = (*s == '-');
+      s++;
+    }
+    if ((s == end) || ((end - s) > 4))
+      return false;
+    for (; s < end; s++) {
+      if (!putval_is_digit(*s))
+        return false;
+      exp_value = 10 * exp_value + (*s - '0');
+    }
+    exponent += exp_negative ? -exp_value : exp_value;
+  }
+
+  if (s != end)
+    return false;
+
+  if (mantissa == 0) {
+    *ret = negative ? -0.0 : 0.0;
+    return true;
+  }
+  if ((mantissa > ((uint64_t)1 << 53)) || (exponent < -22) || (exponent > 22))
+    return false;
+
+  double value = (double)mantissa;
+  if (exponent < 0)
+    value /= powers[-exponent];
+  else
+    value *= powers[exponent];
+
+  *ret = negative ? -value : value;
+  return true;
+} /* }}} bool putval_parse_double */
+
+/* Parses a decimal integer without leading zeros. Octal and hexadecimal
+ * numbers, which strtoll(3) and strtoull(3) accept with base 0, are left to
+ * the slow path. */
+static bool putval_parse_uint(const char *s, const char *end, /* {{{ */
+                              uint64_t *ret) {
+  uint64_t value = 0;
+
+  if ((s == end) || ((end - s) > 19) || ((*s == '0') && ((end - s) > 1)))
+    return false;
+
+  for (; s < end; s++) {
+    if (!putval_is_digit(*s))
+      return false;
+    value = 10 * value + (uint64_t)(*s - '0');
+  }
+
+  *ret = value;
+  return true;
+} /* }}} bool putval_parse_uint */
+
+static bool putval_parse_value(const char *s, const char *end, /* {{{ */
+                               int ds_type, value_t *ret) {
+  uint64_t tmp;
+
+  switch (ds_type) {
+  case DS_TYPE_GAUGE:
+    if (((end - s) == 1) && (*s == 'U')) {
+      ret->gauge = NAN;
+      return true;
+    }
+    return putval_parse_double(s, end, &ret->gauge);
+
+  case DS_TYPE_DERIVE: {
+    bool negative = false;
+    if ((s < end) && ((*s == '-') || (*s == '+'))) {
+      negative = (*s == '-');
+      s++;
+    }
+    /* 18 digits cannot overflow an int64_t. */
+    if (((end - s) > 18) || !putval_parse_uint(s, end, &tmp))
+      return false;
+    ret->derive = negative ? -(derive_t)tmp : (derive_t)tmp;
+    return true;
+  }
+
+  case DS_TYPE_COUNTER:
+  case DS_TYPE_ABSOLUTE:
+    /* 19 digits cannot overflow an uint64_t. */
+    if (!putval_parse_uint(s, end, &tmp))
+      return false;
+    if (ds_type == DS_TYPE_COUNTER)
+      ret->counter = (counter_t)tmp;
+    else
+      ret->absolute = (absolute_t)tmp;
+    return true;
+  }
+
+  return false;
+} /* }}} bool putval_parse_value */
+
+/* Parses "<time>:<value>[:<value>...]" into the values of `vl'. */
+static bool putval_parse_values(const char *s, const char *end, /* {{{ */
+                                value_list_t *vl, const data_set_t *ds) {
+  const char *field_end = memchr(s, ':', end - s);
+  if ((field_end == NULL) || (field_end == s))
+    return false;
+
+  if (((field_end - s) == 1) && (*s == 'N')) {
+    vl->time = cdtime();
+  } else {
+    double tmp;
+    if (!putval_parse_double(s, field_end, &tmp))
+      return false;
+    /* parse_values() treats a zero time as missing. */
+    if (tmp == 0.0)
+      return false;
+    vl->time = DOUBLE_TO_CDTIME_T(tmp);
+  }
+
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    s = field_end + 1;
+    if (s >= end)
+      return false;
+
+    field_end = memchr(s, ':', end - s);
+    if (field_end == NULL)
+      field_end = end;
+
+    if (!putval_parse_value(s, field_end, ds->ds[i].type, &vl->values[i]))
+      return false;
+  }
+
+  /* Exactly `ds_num' values are required. */
+  return field_end == end;
+} /* }}} bool putval_parse_values */
+
+/* Looks up the identifier in the cache, parsing and adding it on a miss. The
+ * cached value list is a copy of `vl' with only the identifier filled in. */
+static bool putval_lookup_identifier(const char *s, size_t len, /* {{{ */
+                                     value_list_t *vl,
+                                     const data_set_t **ret_ds) {
+  /* FNV-1a */
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < len; i++)
+    hash = (hash ^ (unsigned char)s[i]) * 16777619u;
+  putval_cache_entry_t *entry = putval_cache + (hash % PUTVAL_CACHE_SIZE);
+
+  pthread_mutex_lock(&putval_cache_lock);
+  if ((entry->identifier != NULL) && (entry->identifier_len == len) &&
+      (memcmp(entry->identifier, s, len) == 0)) {
+    memcpy(vl, &entry->vl, sizeof(*vl));
+    *ret_ds = entry->ds;
+    pthread_mutex_unlock(&putval_cache_lock);
+    return true;
+  }
+  pthread_mutex_unlock(&putval_cache_lock);
+
+  char buffer[6 * DATA_MAX_NAME_LEN];
+  char *host, *plugin, *plugin_instance, *type, *type_instance;
+
+  if (len >= sizeof(buffer))
+    return false;
+  memcpy(buffer, s, len);
+  buffer[len] = 0;
+
+  if ((parse_identifier(buffer, &host, &plugin, &plugin_instance, &type,
+                        &type_instance, /* default_host = */ NULL) != 0) ||
+      (strlen(host) >= sizeof(vl->host)) ||
+      (strlen(plugin) >= sizeof(vl->plugin)) ||
+      ((plugin_instance != NULL) &&
+       (strlen(plugin_instance) >= sizeof(vl->plugin_instance))) ||
+      ((type_instance != NULL) &&
+       (strlen(type_instance) >= sizeof(vl->type_instance))))
+    return false;
+
+  const data_set_t *ds = plugin_get_ds(type);
+  if (ds == NULL)
+    return false;
+
+  sstrncpy(vl->host, host, sizeof(vl->host));
+  sstrncpy(vl->plugin, plugin, sizeof(vl->plugin));
+  sstrncpy(vl->plugin_instance, (plugin_instance != NULL) ? plugin_instance : "",
+           sizeof(vl->plugin_instance));
+  sstrncpy(vl->type, type, sizeof(vl->type));
+  sstrncpy(vl->type_instance, (type_instance != NULL) ? type_instance : "",
+           sizeof(vl->type_instance));
+  *ret_ds = ds;
+
+  char *identifier = malloc(len);
+  if (identifier == NULL)
+    return true;
+  memcpy(identifier, s, len);
+
+  pthread_mutex_lock(&putval_cache_lock);
+  sfree(entry->identifier);
+  entry->identifier = identifier;
+  entry->identifier_len = len;
+  memcpy(&entry->vl, vl, sizeof(entry->vl));
+  entry->ds = ds;
+  pthread_mutex_unlock(&putval_cache_lock);
+
+  return true;
+} /* }}} bool putval_lookup_identifier */
+
+/* Finds the next field, which is either unquoted or completely enclosed in
+ * double quotes without escapes. Returns false for anything else. */
+static bool putval_next_field(const char **ptr, const char **ret_begin, /* {{{ */
+                              const char **ret_end) {
+  const char *s = *ptr;
+
+  while (putval_is_space(*s))
+    s++;
+
+  if (*s == '"') {
+    const char *end = strchr(s + 1, '"');
+    if ((end == NULL) || (memchr(s + 1, '\\', end - (s + 1)) != NULL) ||
+        ((end[1] != 0) && !putval_is_space(end[1])))
+      return false;
+    *ret_begin = s + 1;
+    *ret_end = end;
+    *ptr = end + 1;
+    return true;
+  }
+
+  const char *end = s;
+  while ((*end != 0) && !putval_is_space(*end)) {
+    if (*end == '"')
+      return false;
+    end++;
+  }
+
+  *ret_begin = s;
+  *ret_end = end;
+  *ptr = end;
+  return true;
+} /* }}} bool putval_next_field */
+
 /*
  * public API
  */
@@ -271,6 +578,69 @@ void cmd_destroy_putval(cmd_putval_t *putval) {
   putval->vl_num = 0;
 } /* void cmd_destroy_putval */
 
+bool cmd_parse_putval_fast(const char *buffer, /* {{{ */
+                           cmd_putval_fast_t *ret) {
+  value_list_t vl = VALUE_LIST_INIT;
+  const data_set_t *ds = NULL;
+  size_t values_num = 0;
+  const char *ptr = buffer;
+  const char *begin;
+  const char *end;
+
+  ret->vl_num = 0;
+
+  if (!putval_next_field(&ptr, &begin, &end) || ((end - begin) != 6) ||
+      (strncasecmp("PUTVAL", begin, 6) != 0))
+    return false;
+
+  if (!putval_next_field(&ptr, &begin, &end) || (begin == end) ||
+      !putval_lookup_identifier(begin, end - begin, &vl, &ds))
+    return false;
+
+  while (putval_next_field(&ptr, &begin, &end)) {
+    if (begin == end) {
+      /* End of line, unless this was an empty quoted string. */
+      if (*begin != 0)
+        return false;
+      break;
+    }
+
+    /* Options, see cmd_parse_option(). Only "interval" is handled here. */
+    const char *equal = begin;
+    while ((equal < end) && (isalnum((unsigned char)*equal) ||
+                             (*equal == '_') || (*equal == ':')))
+      equal++;
+    if ((equal < end) && (*equal == '=') && (equal != begin)) {
+      double interval;
+
+      if (((equal - begin) != strlen("interval")) ||
+          (strncasecmp("interval", begin, strlen("interval")) != 0) ||
+          !putval_parse_double(equal + 1, end, &interval))
+        return false;
+      if (interval > 0.0)
+        vl.interval = DOUBLE_TO_CDTIME_T(interval);
+      continue;
+    }
+
+    if ((ret->vl_num >= STATIC_ARRAY_SIZE(ret->vl)) ||
+        ((values_num + ds->ds_num) > STATIC_ARRAY_SIZE(ret->values)))
+      return false;
+
+    value_list_t *v = ret->vl + ret->vl_num;
+    memcpy(v, &vl, sizeof(*v));
+    v->values = ret->values + values_num;
+    v->values_len = ds->ds_num;
+    if (!putval_parse_values(begin, end, v, ds))
+      return false;
+
+    ret->vl_num++;
+    values_num += ds->ds_num;
+  }
+
+  /* Without any values, let the slow path report the error. */
+  return (*ptr == 0) && (ret->vl_num > 0);
+} /* }}} bool cmd_parse_putval_fast */
+
 cmd_status_t cmd_handle_putval(FILE *fh, char *buffer) {
   cmd_error_handler_t err = {cmd_error_fh, fh};
   cmd_t cmd;
@@ -280,6 +650,18 @@ cmd_status_t cmd_handle_putval(FILE *fh, char *buffer) {
   DEBUG("utils_cmd_putval: cmd_handle_putval (fh = %p, buffer = %s);",
         (void *)fh, buffer);
 
+  cmd_putval_fast_t fast;
+  if (cmd_parse_putval_fast(buffer, &fast)) {
+    for (size_t i = 0; i < fast.vl_num; ++i)
+      plugin_dispatch_values(&fast.vl[i]);
+
+    if (fh != stdout)
+      cmd_error(CMD_OK, &err, "Success: %i %s been dispatched.",
+                (int)fast.vl_num,
+                (fast.vl_num == 1) ? "value has" : "values have");
+    return CMD_OK;
+  }
+
   if ((status = cmd_parse(buffer, &cmd, NULL, &err)) != CMD_OK)
     return status;
   if (cmd.type != CMD_PUTVAL) {
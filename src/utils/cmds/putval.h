@@ -37,6 +37,29 @@ cmd_status_t cmd_parse_putval(size_t argc, char **argv,
                               const cmd_options_t *opts,
                               cmd_error_handler_t *err);
 
+/*
+ * NAME
+ *   cmd_parse_putval_fast
+ *
+ * DESCRIPTION
+ *   Parses a complete, common "PUTVAL" line in a single pass, without
+ *   modifying `buffer' or allocating memory once the identifier has been seen
+ *   before. The values in `ret->vl' point into `ret->values'.
+ *
+ * RETURN VALUE
+ *   True on success. False if the line uses anything the fast path doesn't
+ *   handle, such as escapes, "meta:" options, octal or hexadecimal numbers, or
+ *   if it is invalid. Use cmd_parse() for those, which also reports the
+ *   error.
+ */
+typedef struct {
+  value_list_t vl[8];
+  size_t vl_num;
+  value_t values[64];
+} cmd_putval_fast_t;
+
+bool cmd_parse_putval_fast(const char *buffer, cmd_putval_fast_t *ret);
+
 cmd_status_t cmd_handle_putval(FILE *fh, char *buffer);
 
 void cmd_destroy_putval(cmd_putval_t *putval);
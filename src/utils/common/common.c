@@ -525,10 +525,9 @@ int escape_slashes(char *buffer, size_t buffer_size) {
     buffer_len--;
   }
 
-  for (size_t i = 0; i < buffer_len; i++) {
-    if (buffer[i] == '/')
-      buffer[i] = '_';
-  }
+  for (char *c = memchr(buffer, '/', buffer_len); c != NULL;
+       c = memchr(c + 1, '/', buffer_len - (size_t)(c + 1 - buffer)))
+    *c = '_';
 
   return 0;
 } /* int escape_slashes */
@@ -902,12 +901,124 @@ int format_name(char *ret, int ret_len, const char *hostname,
   return 0;
 } /* int format_name */
 
+#define FNV1A_64_INIT 0xcbf29ce484222325ULL
+#define FNV1A_64_PRIME 0x100000001b3ULL
+
+static uint64_t hash_append(uint64_t hash, const char *str) {
+  for (const unsigned char *ptr = (const unsigned char *)str; *ptr != 0;
+       ptr++) {
+    hash ^= (uint64_t)*ptr;
+    hash *= FNV1A_64_PRIME;
+  }
+  return hash;
+} /* uint64_t hash_append */
+
+uint64_t hash_name(const char *name) {
+  return hash_append(FNV1A_64_INIT, name);
+} /* uint64_t hash_name */
+
+/* Must be kept in sync with format_name() above. */
+uint64_t hash_identifier(const char *hostname, const char *plugin,
+                         const char *plugin_instance, const char *type,
+                         const char *type_instance) {
+  uint64_t hash = FNV1A_64_INIT;
+
+  assert(plugin != NULL);
+  assert(type != NULL);
+
+  hash = hash_append(hash, hostname);
+  hash = hash_append(hash, "/");
+  hash = hash_append(hash, plugin);
+  if ((plugin_instance != NULL) && (plugin_instance[0] != 0)) {
+    hash = hash_append(hash, "-");
+    hash = hash_append(hash, plugin_instance);
+  }
+  hash = hash_append(hash, "/");
+  hash = hash_append(hash, type);
+  if ((type_instance != NULL) && (type_instance[0] != 0)) {
+    hash = hash_append(hash, "-");
+    hash = hash_append(hash, type_instance);
+  }
+
+  return hash;
+} /* uint64_t hash_identifier */
+
+static const char digit_pairs[] = "00010203040506070809"
+                                  "10111213141516171819"
+                                  "20212223242526272829"
+                                  "30313233343536373839"
+                                  "40414243444546474849"
+                                  "50515253545556575859"
+                                  "60616263646566676869"
+                                  "70717273747576777879"
+                                  "80818283848586878889"
+                                  "90919293949596979899";
+
+/* Copies "len" bytes of "str" with snprintf's truncation semantics. */
+static int format_copy(char *buffer, size_t buffer_size, const char *str,
+                       size_t len) {
+  if (buffer_size > 0) {
+    size_t n = (len < buffer_size) ? len : buffer_size - 1;
+    memcpy(buffer, str, n);
+    buffer[n] = 0;
+  }
+  return (int)len;
+} /* int format_copy */
+
+static int format_digits(char *buffer, size_t buffer_size, uint64_t value,
+                         bool negative) {
+  char tmp[21];
+  char *ptr = tmp + sizeof(tmp);
+
+  while (value >= 100) {
+    size_t i = 2 * (size_t)(value % 100);
+    value /= 100;
+    *(--ptr) = digit_pairs[i + 1];
+    *(--ptr) = digit_pairs[i];
+  }
+  if (value >= 10) {
+    size_t i = 2 * (size_t)value;
+    *(--ptr) = digit_pairs[i + 1];
+    *(--ptr) = digit_pairs[i];
+  } else
+    *(--ptr) = (char)('0' + value);
+
+  if (negative)
+    *(--ptr) = '-';
+
+  return format_copy(buffer, buffer_size, ptr,
+                     (size_t)(tmp + sizeof(tmp) - ptr));
+} /* int format_digits */
+
+int format_uint64(char *buffer, size_t buffer_size, uint64_t value) {
+  return format_digits(buffer, buffer_size, value, false);
+} /* int format_uint64 */
+
+int format_int64(char *buffer, size_t buffer_size, int64_t value) {
+  if (value < 0)
+    return format_digits(buffer, buffer_size, (uint64_t)0 - (uint64_t)value,
+                         true);
+  return format_digits(buffer, buffer_size, (uint64_t)value, false);
+} /* int format_int64 */
+
+int format_gauge(char *buffer, size_t buffer_size, gauge_t value) {
+  /* GAUGE_FORMAT prints integers with less than 16 digits as such. */
+  if ((value > -1e15) && (value < 1e15) && (value == (gauge_t)(int64_t)value)) {
+    if ((value == 0.0) && signbit(value))
+      return format_copy(buffer, buffer_size, "-0", 2);
+    return format_int64(buffer, buffer_size, (int64_t)value);
+  }
+
+  return snprintf(buffer, buffer_size, GAUGE_FORMAT, value);
+} /* int format_gauge */
+
 int format_values(char *ret, size_t ret_len, /* {{{ */
                   const data_set_t *ds, const value_list_t *vl,
                   bool store_rates) {
   size_t offset = 0;
   int status;
-  gauge_t *rates = NULL;
+  gauge_t const *rates = NULL;
+  gauge_t *rates_alloc = NULL;
 
   assert(0 == strcmp(ds->type, vl->type));
 
@@ -917,10 +1028,10 @@ int format_values(char *ret, size_t ret_len, /* {{{ */
   do {                                                                         \
     status = snprintf(ret + offset, ret_len - offset, __VA_ARGS__);            \
     if (status < 1) {                                                          \
-      sfree(rates);                                                            \
+      sfree(rates_alloc);                                                      \
       return -1;                                                               \
     } else if (((size_t)status) >= (ret_len - offset)) {                       \
-      sfree(rates);                                                            \
+      sfree(rates_alloc);                                                      \
       return -1;                                                               \
     } else                                                                     \
       offset += ((size_t)status);                                              \
@@ -928,33 +1039,45 @@ int format_values(char *ret, size_t ret_len, /* {{{ */
 
   BUFFER_ADD("%.3f", CDTIME_T_TO_DOUBLE(vl->time));
 
+#define BUFFER_ADD_VALUE(func, value)                                          \
+  do {                                                                         \
+    BUFFER_ADD(":");                                                           \
+    status = func(ret + offset, ret_len - offset, value);                      \
+    if (((size_t)status) >= (ret_len - offset)) {                              \
+      sfree(rates_alloc);                                                      \
+      return -1;                                                               \
+    }                                                                          \
+    offset += ((size_t)status);                                                \
+  } while (0)
+
   for (size_t i = 0; i < ds->ds_num; i++) {
     if (ds->ds[i].type == DS_TYPE_GAUGE)
-      BUFFER_ADD(":" GAUGE_FORMAT, vl->values[i].gauge);
+      BUFFER_ADD_VALUE(format_gauge, vl->values[i].gauge);
     else if (store_rates) {
       if (rates == NULL)
-        rates = uc_get_rate(ds, vl);
+        rates = uc_get_rate_attached(ds, vl, &rates_alloc);
       if (rates == NULL) {
-        WARNING("format_values: uc_get_rate failed.");
+        WARNING("format_values: uc_get_rate_attached failed.");
         return -1;
       }
-      BUFFER_ADD(":" GAUGE_FORMAT, rates[i]);
+      BUFFER_ADD_VALUE(format_gauge, rates[i]);
     } else if (ds->ds[i].type == DS_TYPE_COUNTER)
-      BUFFER_ADD(":%" PRIu64, (uint64_t)vl->values[i].counter);
+      BUFFER_ADD_VALUE(format_uint64, (uint64_t)vl->values[i].counter);
     else if (ds->ds[i].type == DS_TYPE_DERIVE)
-      BUFFER_ADD(":%" PRIi64, vl->values[i].derive);
+      BUFFER_ADD_VALUE(format_int64, vl->values[i].derive);
     else if (ds->ds[i].type == DS_TYPE_ABSOLUTE)
-      BUFFER_ADD(":%" PRIu64, vl->values[i].absolute);
+      BUFFER_ADD_VALUE(format_uint64, vl->values[i].absolute);
     else {
       ERROR("format_values: Unknown data source type: %i", ds->ds[i].type);
-      sfree(rates);
+      sfree(rates_alloc);
       return -1;
     }
   } /* for ds->ds_num */
 
+#undef BUFFER_ADD_VALUE
 #undef BUFFER_ADD
 
-  sfree(rates);
+  sfree(rates_alloc);
   return 0;
 } /* }}} int format_values */
 
@@ -1458,6 +1581,133 @@ int value_to_rate(gauge_t *ret_rate, /* {{{ */
   return 0;
 } /* }}} value_t rate_to_value */
 
+ds_plan_t *ds_plan_create(data_set_t const *ds) /* {{{ */
+{
+  size_t num[DS_TYPE_ABSOLUTE + 1] = {0};
+  bool bounded = false;
+
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    int type = ds->ds[i].type;
+    if ((type < 0) || (type > DS_TYPE_ABSOLUTE)) {
+      P_ERROR("ds_plan_create: Data source \"%s\" of type \"%s\" has unknown "
+              "type %d.",
+              ds->ds[i].name, ds->type, type);
+      return NULL;
+    }
+    num[type]++;
+
+    if (!isnan(ds->ds[i].min) || !isnan(ds->ds[i].max))
+      bounded = true;
+  }
+
+  ds_plan_t *plan = calloc(1, sizeof(*plan));
+  if (plan == NULL)
+    return NULL;
+  plan->ds_num = ds->ds_num;
+  plan->type = -1;
+
+  plan->index = calloc(ds->ds_num + 1, sizeof(*plan->index));
+  if (plan->index == NULL) {
+    ds_plan_destroy(plan);
+    return NULL;
+  }
+
+  for (int t = 0; t <= DS_TYPE_ABSOLUTE; t++) {
+    plan->offset[t + 1] = plan->offset[t] + num[t];
+    if (num[t] == ds->ds_num)
+      plan->type = t;
+  }
+
+  size_t next[DS_TYPE_ABSOLUTE + 1];
+  memcpy(next, plan->offset, sizeof(next));
+  for (size_t i = 0; i < ds->ds_num; i++)
+    plan->index[next[ds->ds[i].type]++] = i;
+
+  if (bounded) {
+    plan->min = calloc(ds->ds_num + 1, sizeof(*plan->min));
+    plan->max = calloc(ds->ds_num + 1, sizeof(*plan->max));
+    if ((plan->min == NULL) || (plan->max == NULL)) {
+      ds_plan_destroy(plan);
+      return NULL;
+    }
+    for (size_t i = 0; i < ds->ds_num; i++) {
+      plan->min[i] = ds->ds[i].min;
+      plan->max[i] = ds->ds[i].max;
+    }
+  }
+
+  return plan;
+} /* }}} ds_plan_t *ds_plan_create */
+
+void ds_plan_destroy(ds_plan_t *plan) /* {{{ */
+{
+  if (plan == NULL)
+    return;
+
+  free(plan->index);
+  free(plan->min);
+  free(plan->max);
+  free(plan);
+} /* }}} void ds_plan_destroy */
+
+void ds_plan_rates(ds_plan_t const *plan, gauge_t *rates, /* {{{ */
+                   value_t const *values, value_t const *prev,
+                   cdtime_t interval) {
+  gauge_t const interval_g = CDTIME_T_TO_DOUBLE(interval);
+  size_t const n = plan->ds_num;
+
+  /* Data sets whose data sources share one type, which are most of them, are
+   * converted in tight loops over the contiguous value arrays. */
+  if (plan->type == DS_TYPE_GAUGE) {
+    for (size_t i = 0; i < n; i++)
+      rates[i] = values[i].gauge;
+  } else if (plan->type == DS_TYPE_DERIVE) {
+    for (size_t i = 0; i < n; i++)
+      rates[i] = ((gauge_t)(values[i].derive - prev[i].derive)) / interval_g;
+  } else if (plan->type == DS_TYPE_ABSOLUTE) {
+    for (size_t i = 0; i < n; i++)
+      rates[i] = ((gauge_t)values[i].absolute) / interval_g;
+  } else {
+    size_t const *index = plan->index;
+    size_t const *offset = plan->offset;
+
+    for (size_t k = offset[DS_TYPE_GAUGE]; k < offset[DS_TYPE_GAUGE + 1]; k++)
+      rates[index[k]] = values[index[k]].gauge;
+
+    for (size_t k = offset[DS_TYPE_DERIVE]; k < offset[DS_TYPE_DERIVE + 1];
+         k++) {
+      size_t i = index[k];
+      rates[i] = ((gauge_t)(values[i].derive - prev[i].derive)) / interval_g;
+    }
+
+    for (size_t k = offset[DS_TYPE_ABSOLUTE]; k < offset[DS_TYPE_ABSOLUTE + 1];
+         k++) {
+      size_t i = index[k];
+      rates[i] = ((gauge_t)values[i].absolute) / interval_g;
+    }
+
+    for (size_t k = offset[DS_TYPE_COUNTER]; k < offset[DS_TYPE_COUNTER + 1];
+         k++) {
+      size_t i = index[k];
+      counter_t diff = counter_diff(prev[i].counter, values[i].counter);
+      rates[i] = ((gauge_t)diff) / interval_g;
+    }
+  }
+
+  ds_plan_check_range(plan, rates);
+} /* }}} void ds_plan_rates */
+
+void ds_plan_check_range(ds_plan_t const *plan, gauge_t *rates) /* {{{ */
+{
+  if (plan->min == NULL)
+    return;
+
+  /* Comparisons with NAN are false, so NAN rates and bounds are left alone. */
+  for (size_t i = 0; i < plan->ds_num; i++)
+    if ((rates[i] < plan->min[i]) || (rates[i] > plan->max[i]))
+      rates[i] = NAN;
+} /* }}} void ds_plan_check_range */
+
 int service_name_to_port_number(const char *service_name) {
   struct addrinfo *ai_list;
   int status;
@@ -323,6 +323,26 @@ int format_name(char *ret, int ret_len, const char *hostname,
 #define FORMAT_VL(ret, ret_len, vl)                                            \
   format_name(ret, ret_len, (vl)->host, (vl)->plugin, (vl)->plugin_instance,   \
               (vl)->type, (vl)->type_instance)
+
+/* hash_name calculates a 64-bit FNV-1a hash of an identifier in its string
+ * form, i.e. as returned by format_name. hash_identifier returns the same
+ * hash, but calculates it from the identifier's parts, without formatting the
+ * identifier first. */
+uint64_t hash_name(const char *name);
+uint64_t hash_identifier(const char *hostname, const char *plugin,
+                         const char *plugin_instance, const char *type,
+                         const char *type_instance);
+#define HASH_VL(vl)                                                            \
+  hash_identifier((vl)->host, (vl)->plugin, (vl)->plugin_instance,             \
+                  (vl)->type, (vl)->type_instance)
+
+/* format_uint64, format_int64 and format_gauge print a single value like
+ * snprintf with "%" PRIu64, "%" PRIi64 and GAUGE_FORMAT would, and return the
+ * same value as snprintf, but avoid the format string parsing. Integral
+ * gauges are printed without going through the floating point code. */
+int format_uint64(char *buffer, size_t buffer_size, uint64_t value);
+int format_int64(char *buffer, size_t buffer_size, int64_t value);
+int format_gauge(char *buffer, size_t buffer_size, gauge_t value);
 int format_values(char *ret, size_t ret_len, const data_set_t *ds,
                   const value_list_t *vl, bool store_rates);
 
@@ -378,6 +398,37 @@ int rate_to_value(value_t *ret_value, gauge_t rate,
 int value_to_rate(gauge_t *ret_rate, value_t value, int ds_type, cdtime_t t,
                   value_to_rate_state_t *state);
 
+/* Conversion plan of a data set, created once per data set so that the rates
+ * of all its values can be computed without switching on the type of every
+ * data source. The indices of the data sources of type `t' are
+ * index[offset[t]] to index[offset[t + 1] - 1]. `type' is the type shared by
+ * all data sources, or -1 if the types are mixed. `min' and `max' hold the
+ * bounds of all data sources (NAN if unbounded) and are NULL if no data source
+ * is bounded. */
+struct ds_plan_s {
+  size_t ds_num;
+  int type;
+  size_t *index;
+  size_t offset[DS_TYPE_ABSOLUTE + 2];
+  gauge_t *min;
+  gauge_t *max;
+};
+typedef struct ds_plan_s ds_plan_t;
+
+/* Returns a new plan for `ds', or NULL on error. */
+ds_plan_t *ds_plan_create(data_set_t const *ds);
+void ds_plan_destroy(ds_plan_t *plan);
+
+/* Computes the rates of `values' from the values of the previous update,
+ * `prev', `interval' earlier, like value_to_rate() does for a single value.
+ * All arrays have plan->ds_num elements. Rates outside of the bounds of their
+ * data source are set to NAN. */
+void ds_plan_rates(ds_plan_t const *plan, gauge_t *rates, value_t const *values,
+                   value_t const *prev, cdtime_t interval);
+
+/* Sets the rates outside of the bounds of their data source to NAN. */
+void ds_plan_check_range(ds_plan_t const *plan, gauge_t *rates);
+
 /* Converts a service name (a string) to a port number
  * (in the range [1-65535]). Returns less than zero on error. */
 int service_name_to_port_number(const char *service_name);
@@ -375,6 +375,147 @@ DEF_TEST(value_to_rate) {
   return 0;
 }
 
+DEF_TEST(ds_plan) {
+  data_source_t sources[] = {
+      {"c", DS_TYPE_COUNTER, 0.0, NAN},  {"g", DS_TYPE_GAUGE, NAN, NAN},
+      {"d", DS_TYPE_DERIVE, 0.0, 50.0},  {"a", DS_TYPE_ABSOLUTE, 0.0, NAN},
+      {"d2", DS_TYPE_DERIVE, NAN, NAN},
+  };
+  data_set_t mixed = {"mixed", STATIC_ARRAY_SIZE(sources), sources};
+  data_set_t uniform = {"uniform", 1, sources + 4};
+
+  ds_plan_t *plan;
+  CHECK_NOT_NULL(plan = ds_plan_create(&mixed));
+  EXPECT_EQ_INT(-1, plan->type);
+  OK(plan->min != NULL);
+  EXPECT_EQ_INT(2, (int)(plan->offset[DS_TYPE_DERIVE + 1] -
+                          plan->offset[DS_TYPE_DERIVE]));
+
+  value_t prev[] = {{.counter = 4294967238ULL},
+                    {.gauge = 0},
+                    {.derive = 1000},
+                    {.absolute = 0},
+                    {.derive = 2000}};
+  value_t values[] = {{.counter = 42},
+                      {.gauge = 3.5},
+                      {.derive = 2000},
+                      {.absolute = 300},
+                      {.derive = 1800}};
+  gauge_t rates[STATIC_ARRAY_SIZE(sources)];
+  ds_plan_rates(plan, rates, values, prev, TIME_T_TO_CDTIME_T(10));
+
+  /* Equal to what value_to_rate() returns for each value; the derive rate of
+   * 100 exceeds the data source's maximum. */
+  EXPECT_EQ_DOUBLE(10.0, rates[0]);
+  EXPECT_EQ_DOUBLE(3.5, rates[1]);
+  EXPECT_EQ_DOUBLE(NAN, rates[2]);
+  EXPECT_EQ_DOUBLE(30.0, rates[3]);
+  EXPECT_EQ_DOUBLE(-20.0, rates[4]);
+  ds_plan_destroy(plan);
+
+  CHECK_NOT_NULL(plan = ds_plan_create(&uniform));
+  EXPECT_EQ_INT(DS_TYPE_DERIVE, plan->type);
+  OK(plan->min == NULL);
+  ds_plan_rates(plan, rates, values + 4, prev + 4, TIME_T_TO_CDTIME_T(10));
+  EXPECT_EQ_DOUBLE(-20.0, rates[0]);
+  ds_plan_destroy(plan);
+
+  return 0;
+}
+
+DEF_TEST(hash_identifier) {
+  struct {
+    char *host;
+    char *plugin;
+    char *plugin_instance;
+    char *type;
+    char *type_instance;
+  } cases[] = {
+      {"example.com", "cpu", "0", "cpu", "idle"},
+      {"example.com", "load", "", "load", ""},
+      {"example.com", "load", NULL, "load", NULL},
+      {"", "memory", "", "memory", "used"},
+      {"example.com", "cpu-0", "", "cpu", "idle"},
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    char name[6 * DATA_MAX_NAME_LEN];
+
+    CHECK_ZERO(format_name(name, sizeof(name), cases[i].host, cases[i].plugin,
+                           cases[i].plugin_instance, cases[i].type,
+                           cases[i].type_instance));
+    EXPECT_EQ_UINT64(hash_name(name),
+                     hash_identifier(cases[i].host, cases[i].plugin,
+                                     cases[i].plugin_instance, cases[i].type,
+                                     cases[i].type_instance));
+  }
+
+  /* The hash must depend on the identifier, not only on its parts. */
+  OK(hash_identifier("example.com", "cpu", "0", "cpu", "idle") !=
+     hash_identifier("example.com", "cpu", "0", "cpu", "user"));
+  OK(hash_name("example.com/load/load") != hash_name("example.com/load/loa"));
+
+  return 0;
+}
+
+DEF_TEST(format_numbers) {
+  gauge_t gauges[] = {0.0,
+                      -0.0,
+                      1.0,
+                      -1.0,
+                      42.0,
+                      0.5,
+                      0.1 + 0.2,
+                      1.0 / 3.0,
+                      123456789012345.0,
+                      -123456789012345.0,
+                      1e15,
+                      -1e15,
+                      1e300,
+                      4294967296.0,
+                      NAN,
+                      INFINITY,
+                      -INFINITY};
+  int64_t ints[] = {0, 1, -1, 9, 10, 99, 100, INT64_MAX, INT64_MIN};
+  uint64_t uints[] = {0, 7, 10, 65536, UINT64_MAX};
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(gauges); i++) {
+    char want[64];
+    char got[64];
+    int want_len = snprintf(want, sizeof(want), GAUGE_FORMAT, gauges[i]);
+
+    EXPECT_EQ_INT(want_len, format_gauge(got, sizeof(got), gauges[i]));
+    EXPECT_EQ_STR(want, got);
+  }
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(ints); i++) {
+    char want[64];
+    char got[64];
+    int want_len = snprintf(want, sizeof(want), "%" PRIi64, ints[i]);
+
+    EXPECT_EQ_INT(want_len, format_int64(got, sizeof(got), ints[i]));
+    EXPECT_EQ_STR(want, got);
+  }
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(uints); i++) {
+    char want[64];
+    char got[64];
+    int want_len = snprintf(want, sizeof(want), "%" PRIu64, uints[i]);
+
+    EXPECT_EQ_INT(want_len, format_uint64(got, sizeof(got), uints[i]));
+    EXPECT_EQ_STR(want, got);
+  }
+
+  /* Truncation works like with snprintf. */
+  char small[4];
+  EXPECT_EQ_INT(5, format_int64(small, sizeof(small), -1234));
+  EXPECT_EQ_STR("-12", small);
+  EXPECT_EQ_INT(6, format_gauge(small, sizeof(small), 123456.0));
+  EXPECT_EQ_STR("123", small);
+
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(sstrncpy);
   RUN_TEST(sstrdup);
@@ -385,6 +526,9 @@ int main(void) {
   RUN_TEST(strunescape);
   RUN_TEST(parse_values);
   RUN_TEST(value_to_rate);
+  RUN_TEST(ds_plan);
+  RUN_TEST(hash_identifier);
+  RUN_TEST(format_numbers);
 
   END_TEST;
 }
@@ -0,0 +1,375 @@
+/**
+ * collectd - src/utils/curl_loop/curl_loop.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "utils/avltree/avltree.h"
+#include "utils/common/common.h"
+#include "utils/curl_loop/curl_loop.h"
+
+/* curl_multi_poll() and curl_multi_wakeup() appeared in 7.66.0 and 7.68.0.
+ * Without them, the loop polls with a short timeout to pick up new and
+ * removed transfers. */
+#if LIBCURL_VERSION_NUM >= 0x074400
+#define CURL_LOOP_HAVE_WAKEUP 1
+#define CURL_LOOP_POLL_MS 1000
+#else
+#define CURL_LOOP_POLL_MS 50
+#endif
+
+typedef struct curl_loop_entry_s curl_loop_entry_t;
+struct curl_loop_entry_s {
+  CURL *curl;
+  curl_loop_callback_t callback;
+  void *user_data;
+  plugin_ctx_t ctx;
+
+  /* Whether the handle has been added to the multi handle. */
+  bool active;
+  /* Whether curl_loop_remove() waits for the entry to go away. */
+  bool remove;
+
+  /* Next entry in the queue of entries to add to the multi handle. */
+  curl_loop_entry_t *next;
+};
+
+struct curl_loop_s {
+  char *name;
+
+  pthread_mutex_t lock;
+  pthread_cond_t removed;
+  pthread_t thread;
+  bool thread_running;
+  bool shutdown;
+
+  CURLM *multi;
+
+  /* All entries, keyed by their easy handle. */
+  c_avl_tree_t *entries;
+  curl_loop_entry_t *pending_head;
+  curl_loop_entry_t *pending_tail;
+  size_t remove_num;
+};
+
+static int curl_loop_compare(void const *a, void const *b) /* {{{ */
+{
+  uintptr_t ua = (uintptr_t)a;
+  uintptr_t ub = (uintptr_t)b;
+
+  if (ua < ub)
+    return -1;
+  return (ua > ub) ? 1 : 0;
+} /* }}} int curl_loop_compare */
+
+static void curl_loop_wakeup(curl_loop_t *loop) /* {{{ */
+{
+#ifdef CURL_LOOP_HAVE_WAKEUP
+  curl_multi_wakeup(loop->multi);
+#else
+  (void)loop;
+#endif
+} /* }}} void curl_loop_wakeup */
+
+/* Removes "e" from the multi handle and the entry tree and frees it. The
+ * caller must hold the lock and make sure "e" is not in the pending queue. */
+static void curl_loop_drop(curl_loop_t *loop, curl_loop_entry_t *e) /* {{{ */
+{
+  if (e->active)
+    curl_multi_remove_handle(loop->multi, e->curl);
+  c_avl_remove(loop->entries, e->curl, NULL, NULL);
+  sfree(e);
+} /* }}} void curl_loop_drop */
+
+static void curl_loop_add_pending(curl_loop_t *loop) /* {{{ */
+{
+  while (loop->pending_head != NULL) {
+    curl_loop_entry_t *e = loop->pending_head;
+    loop->pending_head = e->next;
+    e->next = NULL;
+
+    /* Entries removed before they were started are dropped by
+     * curl_loop_handle_removals(). */
+    if (e->remove)
+      continue;
+
+    CURLMcode status = curl_multi_add_handle(loop->multi, e->curl);
+    if (status != CURLM_OK) {
+      ERROR("%s: curl_multi_add_handle failed: %s", loop->name,
+            curl_multi_strerror(status));
+      plugin_ctx_t old_ctx = plugin_set_ctx(e->ctx);
+      (*e->callback)(e->curl, CURLE_FAILED_INIT, e->user_data);
+      plugin_set_ctx(old_ctx);
+      curl_loop_drop(loop, e);
+      continue;
+    }
+    e->active = true;
+  }
+  loop->pending_tail = NULL;
+} /* }}} void curl_loop_add_pending */
+
+static void curl_loop_handle_removals(curl_loop_t *loop) /* {{{ */
+{
+  if (loop->remove_num == 0)
+    return;
+
+  c_avl_iterator_t *iter = c_avl_get_iterator(loop->entries);
+  curl_loop_entry_t *remove[loop->remove_num];
+  size_t remove_num = 0;
+  CURL *curl;
+  curl_loop_entry_t *e;
+
+  while ((remove_num < loop->remove_num) &&
+         (c_avl_iterator_next(iter, (void *)&curl, (void *)&e) == 0)) {
+    if (e->remove)
+      remove[remove_num++] = e;
+  }
+  c_avl_iterator_destroy(iter);
+
+  for (size_t i = 0; i < remove_num; i++)
+    curl_loop_drop(loop, remove[i]);
+
+  loop->remove_num = 0;
+  pthread_cond_broadcast(&loop->removed);
+} /* }}} void curl_loop_handle_removals */
+
+static void curl_loop_handle_done(curl_loop_t *loop) /* {{{ */
+{
+  CURLMsg *msg;
+  int msgs_left;
+
+  while ((msg = curl_multi_info_read(loop->multi, &msgs_left)) != NULL) {
+    if (msg->msg != CURLMSG_DONE)
+      continue;
+
+    /* "msg" is invalid once the handle has been removed. */
+    CURL *curl = msg->easy_handle;
+    CURLcode result = msg->data.result;
+
+    curl_loop_entry_t *e = NULL;
+    if (c_avl_get(loop->entries, curl, (void *)&e) != 0)
+      continue;
+
+    curl_multi_remove_handle(loop->multi, curl);
+    e->active = false;
+
+    /* Entries to be removed are dropped by curl_loop_handle_removals(). */
+    if (e->remove)
+      continue;
+
+    plugin_ctx_t old_ctx = plugin_set_ctx(e->ctx);
+    (*e->callback)(curl, result, e->user_data);
+    plugin_set_ctx(old_ctx);
+    curl_loop_drop(loop, e);
+  }
+} /* }}} void curl_loop_handle_done */
+
+static void *curl_loop_thread(void *arg) /* {{{ */
+{
+  curl_loop_t *loop = arg;
+
+  pthread_mutex_lock(&loop->lock);
+  while (!loop->shutdown) {
+    int running = 0;
+
+    curl_loop_add_pending(loop);
+    curl_loop_handle_removals(loop);
+
+    CURLMcode status = curl_multi_perform(loop->multi, &running);
+    if (status != CURLM_OK)
+      ERROR("%s: curl_multi_perform failed: %s", loop->name,
+            curl_multi_strerror(status));
+
+    curl_loop_handle_done(loop);
+    curl_loop_handle_removals(loop);
+
+    if ((loop->pending_head != NULL) || loop->shutdown)
+      continue;
+
+    /* Write callbacks run from curl_multi_perform(), i. e. with the lock
+     * held. The lock is released only while waiting for sockets. */
+    pthread_mutex_unlock(&loop->lock);
+#ifdef CURL_LOOP_HAVE_WAKEUP
+    curl_multi_poll(loop->multi, NULL, 0, CURL_LOOP_POLL_MS, NULL);
+#else
+    curl_multi_wait(loop->multi, NULL, 0, CURL_LOOP_POLL_MS, NULL);
+#endif
+    pthread_mutex_lock(&loop->lock);
+  }
+  pthread_mutex_unlock(&loop->lock);
+
+  return NULL;
+} /* }}} void *curl_loop_thread */
+
+/*
+ * Public functions
+ */
+curl_loop_t *curl_loop_create(char const *name) /* {{{ */
+{
+  curl_loop_t *loop = calloc(1, sizeof(*loop));
+  if (loop == NULL)
+    return NULL;
+
+  loop->name = strdup(name);
+  loop->multi = curl_multi_init();
+  loop->entries = c_avl_create(curl_loop_compare);
+  if ((loop->name == NULL) || (loop->multi == NULL) ||
+      (loop->entries == NULL)) {
+    ERROR("curl_loop_create: allocating the loop failed.");
+    if (loop->multi != NULL)
+      curl_multi_cleanup(loop->multi);
+    if (loop->entries != NULL)
+      c_avl_destroy(loop->entries);
+    sfree(loop->name);
+    sfree(loop);
+    return NULL;
+  }
+
+  pthread_mutex_init(&loop->lock, NULL);
+  pthread_cond_init(&loop->removed, NULL);
+
+  return loop;
+} /* }}} curl_loop_t *curl_loop_create */
+
+void curl_loop_destroy(curl_loop_t *loop) /* {{{ */
+{
+  if (loop == NULL)
+    return;
+
+  pthread_mutex_lock(&loop->lock);
+  loop->shutdown = true;
+  curl_loop_wakeup(loop);
+  bool joinable = loop->thread_running;
+  loop->thread_running = false;
+  pthread_mutex_unlock(&loop->lock);
+
+  if (joinable)
+    pthread_join(loop->thread, NULL);
+
+  CURL *curl;
+  curl_loop_entry_t *e;
+  while (c_avl_pick(loop->entries, (void *)&curl, (void *)&e) == 0) {
+    if (e->active)
+      curl_multi_remove_handle(loop->multi, curl);
+    sfree(e);
+  }
+  c_avl_destroy(loop->entries);
+  curl_multi_cleanup(loop->multi);
+
+  pthread_cond_destroy(&loop->removed);
+  pthread_mutex_destroy(&loop->lock);
+  sfree(loop->name);
+  sfree(loop);
+} /* }}} void curl_loop_destroy */
+
+int curl_loop_add(curl_loop_t *loop, CURL *curl, /* {{{ */
+                  curl_loop_callback_t callback, void *user_data) {
+  if ((loop == NULL) || (curl == NULL) || (callback == NULL))
+    return EINVAL;
+
+  pthread_mutex_lock(&loop->lock);
+
+  if (loop->shutdown) {
+    pthread_mutex_unlock(&loop->lock);
+    return ESHUTDOWN;
+  }
+
+  if (c_avl_get(loop->entries, curl, NULL) == 0) {
+    pthread_mutex_unlock(&loop->lock);
+    return EBUSY;
+  }
+
+  if (!loop->thread_running) {
+    int status = plugin_thread_create(&loop->thread, curl_loop_thread, loop,
+                                      loop->name);
+    if (status != 0) {
+      ERROR("%s: plugin_thread_create failed: %s", loop->name,
+            STRERROR(status));
+      pthread_mutex_unlock(&loop->lock);
+      return status;
+    }
+    loop->thread_running = true;
+  }
+
+  curl_loop_entry_t *e = calloc(1, sizeof(*e));
+  if (e == NULL) {
+    pthread_mutex_unlock(&loop->lock);
+    return ENOMEM;
+  }
+  e->curl = curl;
+  e->callback = callback;
+  e->user_data = user_data;
+  e->ctx = plugin_get_ctx();
+
+  if (c_avl_insert(loop->entries, e->curl, e) != 0) {
+    pthread_mutex_unlock(&loop->lock);
+    sfree(e);
+    return ENOMEM;
+  }
+
+  if (loop->pending_tail == NULL)
+    loop->pending_head = e;
+  else
+    loop->pending_tail->next = e;
+  loop->pending_tail = e;
+
+  curl_loop_wakeup(loop);
+  pthread_mutex_unlock(&loop->lock);
+  return 0;
+} /* }}} int curl_loop_add */
+
+bool curl_loop_busy(curl_loop_t *loop, CURL *curl) /* {{{ */
+{
+  if (loop == NULL)
+    return false;
+
+  pthread_mutex_lock(&loop->lock);
+  bool busy = (c_avl_get(loop->entries, curl, NULL) == 0);
+  pthread_mutex_unlock(&loop->lock);
+
+  return busy;
+} /* }}} bool curl_loop_busy */
+
+void curl_loop_remove(curl_loop_t *loop, CURL *curl) /* {{{ */
+{
+  if (loop == NULL)
+    return;
+
+  pthread_mutex_lock(&loop->lock);
+
+  curl_loop_entry_t *e = NULL;
+  if (c_avl_get(loop->entries, curl, (void *)&e) != 0) {
+    pthread_mutex_unlock(&loop->lock);
+    return;
+  }
+
+  if (!e->remove) {
+    e->remove = true;
+    loop->remove_num++;
+  }
+  curl_loop_wakeup(loop);
+
+  while (c_avl_get(loop->entries, curl, NULL) == 0)
+    pthread_cond_wait(&loop->removed, &loop->lock);
+
+  pthread_mutex_unlock(&loop->lock);
+} /* }}} void curl_loop_remove */
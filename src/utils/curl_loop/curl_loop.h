@@ -0,0 +1,84 @@
+/**
+ * collectd - src/utils/curl_loop/curl_loop.h
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_CURL_LOOP_H
+#define UTILS_CURL_LOOP_H 1
+
+#include "plugin.h"
+
+#include <curl/curl.h>
+
+/*
+ * Event loop running many cURL transfers concurrently from a single thread,
+ * using one multi handle so connections are kept alive and reused between
+ * transfers. Read callbacks hand their easy handle to the loop and return
+ * immediately; the completion callback is called from the loop thread with the
+ * plugin context of the read callback that started the transfer, so values
+ * dispatched from there get the right interval. All functions are
+ * thread-safe.
+ */
+struct curl_loop_s;
+typedef struct curl_loop_s curl_loop_t;
+
+/*
+ * Called from the loop thread once the transfer of `curl' has finished.
+ * `status' is the result of the transfer as curl_easy_perform(3) would have
+ * returned it.
+ */
+typedef void (*curl_loop_callback_t)(CURL *curl, CURLcode status,
+                                     void *user_data);
+
+/*
+ * curl_loop_create allocates a new loop. Its thread, named `name', is started
+ * when the first transfer is added.
+ */
+curl_loop_t *curl_loop_create(char const *name);
+
+/*
+ * curl_loop_destroy stops the loop thread and frees the loop. Transfers that
+ * are still running are aborted without calling their callbacks.
+ */
+void curl_loop_destroy(curl_loop_t *loop);
+
+/*
+ * curl_loop_add starts the transfer configured in `curl'. Returns EBUSY if a
+ * transfer of `curl' is still running, zero on success and another errno
+ * value on failure.
+ */
+int curl_loop_add(curl_loop_t *loop, CURL *curl, curl_loop_callback_t callback,
+                  void *user_data);
+
+/*
+ * curl_loop_busy returns true if a transfer of `curl' is still running.
+ */
+bool curl_loop_busy(curl_loop_t *loop, CURL *curl);
+
+/*
+ * curl_loop_remove aborts the transfer of `curl', if any, without calling its
+ * callback. When it returns, the loop no longer uses `curl' or the user data
+ * passed with it, so both may be freed. Must not be called concurrently with
+ * or after curl_loop_destroy().
+ */
+void curl_loop_remove(curl_loop_t *loop, CURL *curl);
+
+#endif /* UTILS_CURL_LOOP_H */
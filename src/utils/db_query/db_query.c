@@ -72,6 +72,12 @@ struct udb_result_preparation_area_s /* {{{ */
   char **metadata_buffer;
   char *plugin_instance;
 
+  /* The parts of the value list that are the same for all rows. If the type
+   * instance is assembled from columns, they are appended at
+   * "type_instance_offset". */
+  value_list_t vl;
+  size_t type_instance_offset;
+
   struct udb_result_preparation_area_s *next;
 }; /* }}} */
 typedef struct udb_result_preparation_area_s udb_result_preparation_area_t;
@@ -84,6 +90,11 @@ struct udb_query_preparation_area_s /* {{{ */
   char *plugin;
   char *db_name;
 
+  /* Column names the column positions have been resolved for. They are
+   * reused by subsequent executions as long as the columns don't change. */
+  char **column_names;
+  size_t column_names_num;
+
   udb_result_preparation_area_t *result_prep_areas;
 }; /* }}} */
 
@@ -158,21 +169,17 @@ static int udb_config_set_uint(unsigned int *ret_value, /* {{{ */
  */
 static int udb_result_submit(udb_result_t *r, /* {{{ */
                              udb_result_preparation_area_t *r_area,
-                             udb_query_t const *q,
-                             udb_query_preparation_area_t *q_area) {
-  value_list_t vl = VALUE_LIST_INIT;
+                             udb_query_t const *q) {
+  value_t values[r->values_num];
+  value_list_t vl = r_area->vl;
 
   assert(r != NULL);
   assert(r_area->ds != NULL);
   assert(((size_t)r_area->ds->ds_num) == r->values_num);
   assert(r->values_num > 0);
 
-  vl.values = calloc(r->values_num, sizeof(*vl.values));
-  if (vl.values == NULL) {
-    P_ERROR("udb_result_submit: calloc failed.");
-    return -1;
-  }
-  vl.values_len = r_area->ds->ds_num;
+  vl.values = values;
+  vl.values_len = r->values_num;
 
   for (size_t i = 0; i < r->values_num; i++) {
     char *value_str = r_area->values_buffer[i];
@@ -181,66 +188,32 @@ static int udb_result_submit(udb_result_t *r, /* {{{ */
       P_ERROR("udb_result_submit: Parsing `%s' as %s failed.", value_str,
               DS_TYPE_TO_STRING(r_area->ds->ds[i].type));
       errno = EINVAL;
-      free(vl.values);
       return -1;
     }
   }
 
-  sstrncpy(vl.host, q_area->host, sizeof(vl.host));
-  sstrncpy(vl.plugin, q_area->plugin, sizeof(vl.plugin));
-  sstrncpy(vl.type, r->type, sizeof(vl.type));
-
-  /* Set vl.plugin_instance */
-  if (q->plugin_instance_from != NULL) {
+  if (q->plugin_instance_from != NULL)
     sstrncpy(vl.plugin_instance, r_area->plugin_instance,
              sizeof(vl.plugin_instance));
-  } else {
-    sstrncpy(vl.plugin_instance, q_area->db_name, sizeof(vl.plugin_instance));
-  }
 
-  /* Set vl.type_instance {{{ */
-  if (r->instances_num == 0) {
-    if (r->instance_prefix == NULL)
-      vl.type_instance[0] = 0;
-    else
-      sstrncpy(vl.type_instance, r->instance_prefix, sizeof(vl.type_instance));
-  } else /* if ((r->instances_num > 0) */
-  {
-    if (r->instance_prefix == NULL) {
-      int status = strjoin(vl.type_instance, sizeof(vl.type_instance),
-                           r_area->instances_buffer, r->instances_num, "-");
-      if (status < 0) {
-        P_ERROR(
-            "udb_result_submit: creating type_instance failed with status %d.",
-            status);
-        return status;
-      }
-    } else {
-      char tmp[DATA_MAX_NAME_LEN];
-
-      int status = strjoin(tmp, sizeof(tmp), r_area->instances_buffer,
-                           r->instances_num, "-");
-      if (status < 0) {
-        P_ERROR(
-            "udb_result_submit: creating type_instance failed with status %d.",
-            status);
-        return status;
-      }
-      tmp[sizeof(tmp) - 1] = '\0';
-
-      ssnprintf(vl.type_instance, sizeof(vl.type_instance), "%s-%s",
-                r->instance_prefix, tmp);
+  if (r->instances_num > 0) {
+    size_t offset = r_area->type_instance_offset;
+
+    int status = strjoin(vl.type_instance + offset,
+                         sizeof(vl.type_instance) - offset,
+                         r_area->instances_buffer, r->instances_num, "-");
+    if (status < 0) {
+      P_ERROR("udb_result_submit: creating type_instance failed with status %d.",
+              status);
+      return status;
     }
   }
-  vl.type_instance[sizeof(vl.type_instance) - 1] = '\0';
-  /* }}} */
 
   /* Annotate meta data. {{{ */
   if (r->metadata_num > 0) {
     vl.meta = meta_data_create();
     if (vl.meta == NULL) {
       P_ERROR("udb_result_submit: meta_data_create failed.");
-      free(vl.values);
       return -ENOMEM;
     }
 
@@ -251,7 +224,6 @@ static int udb_result_submit(udb_result_t *r, /* {{{ */
         P_ERROR("udb_result_submit: meta_data_add_string failed.");
         meta_data_destroy(vl.meta);
         vl.meta = NULL;
-        free(vl.values);
         return status;
       }
     }
@@ -264,12 +236,13 @@ static int udb_result_submit(udb_result_t *r, /* {{{ */
     meta_data_destroy(vl.meta);
     vl.meta = NULL;
   }
-  sfree(vl.values);
   return 0;
 } /* }}} void udb_result_submit */
 
-static void udb_result_finish_result(udb_result_t const *r, /* {{{ */
-                                     udb_result_preparation_area_t *prep_area) {
+/* Frees the column positions; they are resolved again by the next call to
+ * udb_result_prepare_result(). */
+static void udb_result_reset(udb_result_t const *r, /* {{{ */
+                             udb_result_preparation_area_t *prep_area) {
   if ((r == NULL) || (prep_area == NULL))
     return;
 
@@ -280,7 +253,7 @@ static void udb_result_finish_result(udb_result_t const *r, /* {{{ */
   sfree(prep_area->instances_buffer);
   sfree(prep_area->values_buffer);
   sfree(prep_area->metadata_buffer);
-} /* }}} void udb_result_finish_result */
+} /* }}} void udb_result_reset */
 
 static int udb_result_handle_result(udb_result_t *r, /* {{{ */
                                     udb_query_preparation_area_t *q_area,
@@ -301,11 +274,13 @@ static int udb_result_handle_result(udb_result_t *r, /* {{{ */
   if (q->plugin_instance_from)
     r_area->plugin_instance = column_values[q_area->plugin_instance_pos];
 
-  return udb_result_submit(r, r_area, q, q_area);
+  return udb_result_submit(r, r_area, q);
 } /* }}} int udb_result_handle_result */
 
 static int udb_result_prepare_result(udb_result_t const *r, /* {{{ */
                                      udb_result_preparation_area_t *prep_area,
+                                     udb_query_t const *q,
+                                     udb_query_preparation_area_t const *q_area,
                                      char **column_names, size_t column_num) {
   if ((r == NULL) || (prep_area == NULL))
     return -EINVAL;
@@ -321,7 +296,7 @@ static int udb_result_prepare_result(udb_result_t const *r, /* {{{ */
 #endif
 
 #define BAIL_OUT(status)                                                       \
-  udb_result_finish_result(r, prep_area);                                      \
+  udb_result_reset(r, prep_area);                                              \
   return (status)
 
   /* Read `ds' and check number of values {{{ */
@@ -447,6 +422,24 @@ static int udb_result_prepare_result(udb_result_t const *r, /* {{{ */
     }
   } /* }}} for (i = 0; i < r->metadata_num; i++) */
 
+  /* Fill in the parts of the value list which don't depend on the row {{{ */
+  prep_area->vl = (value_list_t)VALUE_LIST_INIT;
+  sstrncpy(prep_area->vl.host, q_area->host, sizeof(prep_area->vl.host));
+  sstrncpy(prep_area->vl.plugin, q_area->plugin, sizeof(prep_area->vl.plugin));
+  sstrncpy(prep_area->vl.type, r->type, sizeof(prep_area->vl.type));
+  if (q->plugin_instance_from == NULL)
+    sstrncpy(prep_area->vl.plugin_instance, q_area->db_name,
+             sizeof(prep_area->vl.plugin_instance));
+
+  if ((r->instances_num > 0) && (r->instance_prefix != NULL))
+    ssnprintf(prep_area->vl.type_instance, sizeof(prep_area->vl.type_instance),
+              "%s-", r->instance_prefix);
+  else if (r->instance_prefix != NULL)
+    sstrncpy(prep_area->vl.type_instance, r->instance_prefix,
+             sizeof(prep_area->vl.type_instance));
+  prep_area->type_instance_offset = strlen(prep_area->vl.type_instance);
+  /* }}} */
+
 #undef BAIL_OUT
   return 0;
 } /* }}} int udb_result_prepare_result */
@@ -820,26 +813,61 @@ int udb_query_check_version(udb_query_t *q, unsigned int version) /* {{{ */
   return 1;
 } /* }}} int udb_query_check_version */
 
-void udb_query_finish_result(udb_query_t const *q, /* {{{ */
-                             udb_query_preparation_area_t *prep_area) {
+/* Forgets the resolved column positions. */
+static void udb_query_reset_result(udb_query_t const *q, /* {{{ */
+                                   udb_query_preparation_area_t *prep_area) {
   udb_result_preparation_area_t *r_area;
   udb_result_t *r;
 
-  if ((q == NULL) || (prep_area == NULL))
-    return;
-
   prep_area->column_num = 0;
   sfree(prep_area->host);
   sfree(prep_area->plugin);
   sfree(prep_area->db_name);
 
+  for (size_t i = 0; i < prep_area->column_names_num; i++)
+    sfree(prep_area->column_names[i]);
+  sfree(prep_area->column_names);
+  prep_area->column_names_num = 0;
+
   for (r = q->results, r_area = prep_area->result_prep_areas; r != NULL;
        r = r->next, r_area = r_area->next) {
     /* this may happen during error conditions of the caller */
     if (r_area == NULL)
       break;
-    udb_result_finish_result(r, r_area);
+    udb_result_reset(r, r_area);
   }
+} /* }}} void udb_query_reset_result */
+
+/* Returns true if the column positions resolved by the previous call to
+ * udb_query_prepare_result() are valid for this result, too. */
+static bool udb_query_is_prepared(udb_query_preparation_area_t const *prep_area,
+                                  const char *host, const char *plugin,
+                                  const char *db_name, char **column_names,
+                                  size_t column_num) {
+  if ((prep_area->column_names == NULL) ||
+      (prep_area->column_names_num != column_num))
+    return false;
+
+  if ((strcmp(prep_area->host, host) != 0) ||
+      (strcmp(prep_area->plugin, plugin) != 0) ||
+      (strcmp(prep_area->db_name, db_name) != 0))
+    return false;
+
+  for (size_t i = 0; i < column_num; i++)
+    if (strcmp(prep_area->column_names[i], column_names[i]) != 0)
+      return false;
+
+  return true;
+} /* }}} bool udb_query_is_prepared */
+
+/* Ends handling of a result set. The column positions are kept for the next
+ * execution of the query. */
+void udb_query_finish_result(udb_query_t const *q, /* {{{ */
+                             udb_query_preparation_area_t *prep_area) {
+  if ((q == NULL) || (prep_area == NULL))
+    return;
+
+  prep_area->column_num = 0;
 } /* }}} void udb_query_finish_result */
 
 int udb_query_handle_result(udb_query_t const *q, /* {{{ */
@@ -903,12 +931,16 @@ int udb_query_prepare_result(udb_query_t const *q, /* {{{ */
 
 #if COLLECT_DEBUG
   assert(prep_area->column_num == 0);
-  assert(prep_area->host == NULL);
-  assert(prep_area->plugin == NULL);
-  assert(prep_area->db_name == NULL);
 #endif
 
-  prep_area->column_num = column_num;
+  if (udb_query_is_prepared(prep_area, host, plugin, db_name, column_names,
+                            column_num)) {
+    prep_area->column_num = column_num;
+    return 0;
+  }
+
+  udb_query_reset_result(q, prep_area);
+
   prep_area->host = strdup(host);
   prep_area->plugin = strdup(plugin);
   prep_area->db_name = strdup(db_name);
@@ -916,7 +948,7 @@ int udb_query_prepare_result(udb_query_t const *q, /* {{{ */
   if ((prep_area->host == NULL) || (prep_area->plugin == NULL) ||
       (prep_area->db_name == NULL)) {
     P_ERROR("Query `%s': Prepare failed: Out of memory.", q->name);
-    udb_query_finish_result(q, prep_area);
+    udb_query_reset_result(q, prep_area);
     return -ENOMEM;
   }
 
@@ -945,7 +977,7 @@ int udb_query_prepare_result(udb_query_t const *q, /* {{{ */
       P_ERROR("udb_query_prepare_result: "
               "Column `%s' from `PluginInstanceFrom' could not be found.",
               q->plugin_instance_from);
-      udb_query_finish_result(q, prep_area);
+      udb_query_reset_result(q, prep_area);
       return -ENOENT;
     }
   }
@@ -957,17 +989,35 @@ int udb_query_prepare_result(udb_query_t const *q, /* {{{ */
       P_ERROR("Query `%s': Invalid number of result "
               "preparation areas.",
               q->name);
-      udb_query_finish_result(q, prep_area);
+      udb_query_reset_result(q, prep_area);
       return -EINVAL;
     }
 
-    status = udb_result_prepare_result(r, r_area, column_names, column_num);
+    status = udb_result_prepare_result(r, r_area, q, prep_area, column_names,
+                                       column_num);
     if (status != 0) {
-      udb_query_finish_result(q, prep_area);
+      udb_query_reset_result(q, prep_area);
       return status;
     }
   }
 
+  prep_area->column_names = calloc(column_num, sizeof(*column_names));
+  if (prep_area->column_names == NULL) {
+    P_ERROR("Query `%s': Prepare failed: Out of memory.", q->name);
+    udb_query_reset_result(q, prep_area);
+    return -ENOMEM;
+  }
+  for (size_t i = 0; i < column_num; i++) {
+    prep_area->column_names[i] = strdup(column_names[i]);
+    if (prep_area->column_names[i] == NULL) {
+      P_ERROR("Query `%s': Prepare failed: Out of memory.", q->name);
+      udb_query_reset_result(q, prep_area);
+      return -ENOMEM;
+    }
+    prep_area->column_names_num = i + 1;
+  }
+
+  prep_area->column_num = column_num;
   return 0;
 } /* }}} int udb_query_prepare_result */
 
@@ -1023,8 +1073,10 @@ void udb_query_delete_preparation_area(
 
     sfree(area->instances_pos);
     sfree(area->values_pos);
+    sfree(area->metadata_pos);
     sfree(area->instances_buffer);
     sfree(area->values_buffer);
+    sfree(area->metadata_buffer);
     free(area);
   }
 
@@ -1032,5 +1084,9 @@ void udb_query_delete_preparation_area(
   sfree(q_area->plugin);
   sfree(q_area->db_name);
 
+  for (size_t i = 0; i < q_area->column_names_num; i++)
+    sfree(q_area->column_names[i]);
+  sfree(q_area->column_names);
+
   free(q_area);
 } /* }}} void udb_query_delete_preparation_area */
@@ -261,7 +261,8 @@ static int rfc1035NameUnpack(const char *buf, size_t sz, off_t *off, char *name,
   off_t no = 0;
   unsigned char c;
   size_t len;
-  static int loop_detect;
+  /* Packets may be parsed by several capture threads at once. */
+  static __thread int loop_detect;
   if (loop_detect > 2)
     return 4; /* compression loop */
   if (ns == 0)
@@ -656,6 +657,24 @@ void handle_pcap(u_char *udata, const struct pcap_pkthdr *hdr,
   query_count_total++;
   last_ts = hdr->ts;
 }
+
+/* public function */
+void handle_ip_packet(const u_char *pkt, int len) {
+  if ((len < 1) || ((size_t)len < sizeof(struct ip)))
+    return;
+
+  /* handle_ip() copies the UDP payload into a buffer of this size. */
+  if (len > PCAP_SNAPLEN)
+    len = PCAP_SNAPLEN;
+
+#if HAVE_IPV6
+  if ((((const struct ip *)pkt)->ip_v == 6) &&
+      ((size_t)len < sizeof(struct ip6_hdr)))
+    return;
+#endif
+
+  handle_ip((const struct ip *)pkt, len);
+}
 #endif /* HAVE_PCAP_H */
 
 const char *qtype_str(int t) {
@@ -81,6 +81,9 @@ void ignore_list_add_name(const char *name);
 #if HAVE_PCAP_H
 void handle_pcap(u_char *udata, const struct pcap_pkthdr *hdr,
                  const u_char *pkt);
+/* Parses an IPv4 or IPv6 packet without a link layer header, as received from
+ * an AF_PACKET socket of type SOCK_DGRAM. */
+void handle_ip_packet(const u_char *pkt, int len);
 #endif
 
 const char *qtype_str(int t);
@@ -29,6 +29,12 @@
 #include "utils/format_graphite/format_graphite.h"
 #include "utils_cache.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #define GRAPHITE_FORBIDDEN " \t\"\\:!,/()\n\r"
 
 /* Utils functions to format data sets in graphite format.
@@ -71,8 +77,6 @@ static int gr_format_values(char *ret, size_t ret_len, int ds_num,
 
   assert(0 == strcmp(ds->type, vl->type));
 
-  memset(ret, 0, ret_len);
-
 #define BUFFER_ADD(...)                                                        \
   do {                                                                         \
     status = snprintf(ret + offset, ret_len - offset, __VA_ARGS__);            \
@@ -84,46 +88,122 @@ static int gr_format_values(char *ret, size_t ret_len, int ds_num,
       offset += ((size_t)status);                                              \
   } while (0)
 
+#define BUFFER_ADD_VALUE(func, value)                                          \
+  do {                                                                         \
+    int status = func(ret + offset, ret_len - offset, value);                  \
+    if (((size_t)status) >= (ret_len - offset)) {                              \
+      return -1;                                                               \
+    }                                                                          \
+    offset += ((size_t)status);                                                \
+  } while (0)
+
   if (ds->ds[ds_num].type == DS_TYPE_GAUGE)
-    BUFFER_ADD(GAUGE_FORMAT, vl->values[ds_num].gauge);
+    BUFFER_ADD_VALUE(format_gauge, vl->values[ds_num].gauge);
   else if (rates != NULL)
     BUFFER_ADD("%f", rates[ds_num]);
   else if (ds->ds[ds_num].type == DS_TYPE_COUNTER)
-    BUFFER_ADD("%" PRIu64, (uint64_t)vl->values[ds_num].counter);
+    BUFFER_ADD_VALUE(format_uint64, (uint64_t)vl->values[ds_num].counter);
   else if (ds->ds[ds_num].type == DS_TYPE_DERIVE)
-    BUFFER_ADD("%" PRIi64, vl->values[ds_num].derive);
+    BUFFER_ADD_VALUE(format_int64, vl->values[ds_num].derive);
   else if (ds->ds[ds_num].type == DS_TYPE_ABSOLUTE)
-    BUFFER_ADD("%" PRIu64, vl->values[ds_num].absolute);
+    BUFFER_ADD_VALUE(format_uint64, vl->values[ds_num].absolute);
   else {
     P_ERROR("gr_format_values: Unknown data source type: %i",
             ds->ds[ds_num].type);
     return -1;
   }
 
+#undef BUFFER_ADD_VALUE
 #undef BUFFER_ADD
 
   return 0;
 }
 
+static bool gr_needs_escape(char c, bool preserve_separator) {
+  return (!preserve_separator && (c == '.')) || isspace((int)c) ||
+         iscntrl((int)c);
+}
+
+/* Returns the length of the leading run of "src" (of length "len") that can
+ * be copied verbatim. The vector paths only accept printable ASCII other than
+ * space (and '.', unless preserved) as clean; every other byte is checked
+ * with gr_needs_escape(), so the result is the same as with the scalar loop. */
+static size_t gr_clean_run(const char *src, size_t len,
+                           bool preserve_separator) {
+  size_t i = 0;
+
+#if defined(__SSE2__)
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i del = _mm_set1_epi8(0x7f);
+  const __m128i dot = _mm_set1_epi8('.');
+
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+    /* Signed compares: bytes >= 0x80 are negative and fail the first test. */
+    __m128i ok =
+        _mm_and_si128(_mm_cmpgt_epi8(v, space), _mm_cmplt_epi8(v, del));
+    if (!preserve_separator)
+      ok = _mm_andnot_si128(_mm_cmpeq_epi8(v, dot), ok);
+
+    /* Candidates such as bytes >= 0x80 may still be fine. */
+    unsigned int mask = (unsigned int)_mm_movemask_epi8(ok) ^ 0xffff;
+    for (; mask != 0; mask &= mask - 1) {
+      size_t pos = i + (size_t)__builtin_ctz(mask);
+      if (gr_needs_escape(src[pos], preserve_separator))
+        return pos;
+    }
+  }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+  const uint8x16_t space = vdupq_n_u8(' ');
+  const uint8x16_t del = vdupq_n_u8(0x7f);
+  const uint8x16_t dot = vdupq_n_u8('.');
+
+  for (; i + 16 <= len; i += 16) {
+    uint8x16_t v = vld1q_u8((const uint8_t *)(src + i));
+    uint8x16_t ok = vandq_u8(vcgtq_u8(v, space), vcltq_u8(v, del));
+    if (!preserve_separator)
+      ok = vbicq_u8(ok, vceqq_u8(v, dot));
+
+    if (vminvq_u8(ok) == 0xff)
+      continue;
+    for (size_t pos = i; pos < i + 16; pos++)
+      if (gr_needs_escape(src[pos], preserve_separator))
+        return pos;
+  }
+#endif
+
+  while ((i < len) && !gr_needs_escape(src[i], preserve_separator))
+    i++;
+  return i;
+}
+
 static void gr_copy_escape_part(char *dst, const char *src, size_t dst_len,
                                 char escape_char, bool preserve_separator) {
-  memset(dst, 0, dst_len);
+  if (dst_len == 0)
+    return;
 
-  if (src == NULL)
+  if (src == NULL) {
+    dst[0] = 0;
     return;
+  }
 
-  for (size_t i = 0; i < dst_len; i++) {
-    if (src[i] == 0) {
-      dst[i] = 0;
-      break;
-    }
+  /* Like before, "dst" is only terminated if "src" is shorter than it. */
+  const char *end = memchr(src, 0, dst_len);
+  size_t len = (end != NULL) ? (size_t)(end - src) : dst_len;
+  size_t i = 0;
+  while (i < len) {
+    size_t run = gr_clean_run(src + i, len - i, preserve_separator);
+    memcpy(dst + i, src + i, run);
+    i += run;
 
-    if ((!preserve_separator && (src[i] == '.')) || isspace((int)src[i]) ||
-        iscntrl((int)src[i]))
+    while ((i < len) && gr_needs_escape(src[i], preserve_separator)) {
       dst[i] = escape_char;
-    else
-      dst[i] = src[i];
+      i++;
+    }
   }
+
+  if (len < dst_len)
+    dst[len] = 0;
 }
 
 static int gr_format_name_tagged(char *ret, int ret_len, value_list_t const *vl,
@@ -294,84 +374,327 @@ static void escape_graphite_string(char *buffer, char escape_char) {
     *head = escape_char;
 }
 
+typedef struct gr_cache_entry_s gr_cache_entry_t;
+struct gr_cache_entry_s {
+  uint64_t hash;
+  size_t ds_index;
+  /* host, plugin, plugin instance, type and type instance, each terminated
+   * by a null byte. */
+  char *identifier;
+  char *name;
+  size_t name_len;
+
+  gr_cache_entry_t *bucket_next;
+  /* LRU list, most recently used first */
+  gr_cache_entry_t *prev;
+  gr_cache_entry_t *next;
+};
+
+struct graphite_cache_s {
+  gr_cache_entry_t **buckets;
+  size_t buckets_num; /* power of two */
+  size_t entries_num;
+  size_t entries_max;
+  gr_cache_entry_t *head;
+  gr_cache_entry_t *tail;
+};
+
+graphite_cache_t *graphite_cache_create(size_t max_entries) {
+  graphite_cache_t *cache;
+
+  if (max_entries == 0)
+    return NULL;
+
+  cache = calloc(1, sizeof(*cache));
+  if (cache == NULL)
+    return NULL;
+
+  cache->buckets_num = 16;
+  while (cache->buckets_num < max_entries)
+    cache->buckets_num *= 2;
+  cache->buckets = calloc(cache->buckets_num, sizeof(*cache->buckets));
+  if (cache->buckets == NULL) {
+    sfree(cache);
+    return NULL;
+  }
+  cache->entries_max = max_entries;
+
+  return cache;
+}
+
+static void gr_cache_entry_free(gr_cache_entry_t *e) {
+  if (e == NULL)
+    return;
+
+  sfree(e->identifier);
+  sfree(e->name);
+  sfree(e);
+}
+
+void graphite_cache_destroy(graphite_cache_t *cache) {
+  if (cache == NULL)
+    return;
+
+  while (cache->head != NULL) {
+    gr_cache_entry_t *next = cache->head->next;
+    gr_cache_entry_free(cache->head);
+    cache->head = next;
+  }
+
+  sfree(cache->buckets);
+  sfree(cache);
+}
+
+static uint64_t gr_cache_hash(uint64_t vl_hash, size_t ds_index) {
+  return vl_hash + 0x9e3779b97f4a7c15ULL * (uint64_t)ds_index;
+}
+
+static bool gr_cache_entry_match(gr_cache_entry_t const *e,
+                                 value_list_t const *vl) {
+  char const *fields[] = {vl->host, vl->plugin, vl->plugin_instance, vl->type,
+                          vl->type_instance};
+  char const *ptr = e->identifier;
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(fields); i++) {
+    if (strcmp(ptr, fields[i]) != 0)
+      return false;
+    ptr += strlen(ptr) + 1;
+  }
+  return true;
+}
+
+static void gr_cache_unlink(graphite_cache_t *cache, gr_cache_entry_t *e) {
+  if (e->prev != NULL)
+    e->prev->next = e->next;
+  else
+    cache->head = e->next;
+  if (e->next != NULL)
+    e->next->prev = e->prev;
+  else
+    cache->tail = e->prev;
+  e->prev = e->next = NULL;
+}
+
+static void gr_cache_push(graphite_cache_t *cache, gr_cache_entry_t *e) {
+  e->next = cache->head;
+  if (cache->head != NULL)
+    cache->head->prev = e;
+  cache->head = e;
+  if (cache->tail == NULL)
+    cache->tail = e;
+}
+
+static gr_cache_entry_t *gr_cache_get(graphite_cache_t *cache, uint64_t hash,
+                                      size_t ds_index,
+                                      value_list_t const *vl) {
+  gr_cache_entry_t *e = cache->buckets[hash & (cache->buckets_num - 1)];
+
+  for (; e != NULL; e = e->bucket_next) {
+    if ((e->hash == hash) && (e->ds_index == ds_index) &&
+        gr_cache_entry_match(e, vl))
+      break;
+  }
+
+  if ((e != NULL) && (e != cache->head)) {
+    gr_cache_unlink(cache, e);
+    gr_cache_push(cache, e);
+  }
+  return e;
+}
+
+static void gr_cache_remove(graphite_cache_t *cache, gr_cache_entry_t *e) {
+  gr_cache_entry_t **ptr = &cache->buckets[e->hash & (cache->buckets_num - 1)];
+
+  while (*ptr != e)
+    ptr = &(*ptr)->bucket_next;
+  *ptr = e->bucket_next;
+
+  gr_cache_unlink(cache, e);
+  cache->entries_num--;
+  gr_cache_entry_free(e);
+}
+
+/* Adds a name to the cache. Failures are not reported: the name has been
+ * formatted already and the next call will simply try again. */
+static void gr_cache_add(graphite_cache_t *cache, uint64_t hash,
+                         size_t ds_index, value_list_t const *vl,
+                         char const *name, size_t name_len) {
+  char const *fields[] = {vl->host, vl->plugin, vl->plugin_instance, vl->type,
+                          vl->type_instance};
+  size_t identifier_len = 0;
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(fields); i++)
+    identifier_len += strlen(fields[i]) + 1;
+
+  gr_cache_entry_t *e = calloc(1, sizeof(*e));
+  if (e == NULL)
+    return;
+  e->identifier = malloc(identifier_len);
+  e->name = malloc(name_len + 1);
+  if ((e->identifier == NULL) || (e->name == NULL)) {
+    gr_cache_entry_free(e);
+    return;
+  }
+
+  char *ptr = e->identifier;
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(fields); i++) {
+    size_t len = strlen(fields[i]) + 1;
+    memcpy(ptr, fields[i], len);
+    ptr += len;
+  }
+  memcpy(e->name, name, name_len + 1);
+  e->name_len = name_len;
+  e->hash = hash;
+  e->ds_index = ds_index;
+
+  while ((cache->entries_num >= cache->entries_max) && (cache->tail != NULL))
+    gr_cache_remove(cache, cache->tail);
+
+  size_t bucket = hash & (cache->buckets_num - 1);
+  e->bucket_next = cache->buckets[bucket];
+  cache->buckets[bucket] = e;
+  gr_cache_push(cache, e);
+  cache->entries_num++;
+}
+
+/* Formats the escaped metric name for data source "ds_index" into "ret". */
+static int gr_format_key(char *ret, size_t ret_len, data_set_t const *ds,
+                         value_list_t const *vl, size_t ds_index,
+                         char const *prefix, char const *postfix,
+                         char const escape_char, unsigned int flags) {
+  char const *ds_name = NULL;
+  int status;
+
+  if ((flags & GRAPHITE_ALWAYS_APPEND_DS) || (ds->ds_num > 1))
+    ds_name = ds->ds[ds_index].name;
+
+  /* Copy the identifier to `ret' and escape it. */
+  if (flags & GRAPHITE_USE_TAGS) {
+    status = gr_format_name_tagged(ret, (int)ret_len, vl, ds_name, prefix,
+                                   postfix, escape_char, flags);
+    if (status != 0) {
+      P_ERROR("format_graphite: error with gr_format_name_tagged");
+      return status;
+    }
+  } else {
+    status = gr_format_name(ret, (int)ret_len, vl, ds_name, prefix, postfix,
+                            escape_char, flags);
+    if (status != 0) {
+      P_ERROR("format_graphite: error with gr_format_name");
+      return status;
+    }
+  }
+
+  escape_graphite_string(ret, escape_char);
+  return 0;
+}
+
 int format_graphite(char *buffer, size_t buffer_size, data_set_t const *ds,
                     value_list_t const *vl, char const *prefix,
                     char const *postfix, char const escape_char,
                     unsigned int flags) {
+  return format_graphite_cached(buffer, buffer_size, ds, vl, prefix, postfix,
+                                escape_char, flags, /* cache = */ NULL);
+} /* int format_graphite */
+
+int format_graphite_cached(char *buffer, size_t buffer_size,
+                           data_set_t const *ds, value_list_t const *vl,
+                           char const *prefix, char const *postfix,
+                           char const escape_char, unsigned int flags,
+                           graphite_cache_t *cache) {
   int status = 0;
-  int buffer_pos = 0;
+  size_t buffer_pos = 0;
+  uint64_t vl_hash = 0;
 
-  gauge_t *rates = NULL;
+  gauge_t const *rates = NULL;
+  gauge_t *rates_alloc = NULL;
   if (flags & GRAPHITE_STORE_RATES) {
-    rates = uc_get_rate(ds, vl);
+    rates = uc_get_rate_attached(ds, vl, &rates_alloc);
     if (rates == NULL) {
-      P_ERROR("format_graphite: error with uc_get_rate");
+      P_ERROR("format_graphite: error with uc_get_rate_attached");
       return -1;
     }
   }
 
+  if (cache != NULL)
+    vl_hash = HASH_VL(vl);
+
   for (size_t i = 0; i < ds->ds_num; i++) {
-    char const *ds_name = NULL;
-    char key[10 * DATA_MAX_NAME_LEN];
+    char key_buffer[10 * DATA_MAX_NAME_LEN];
+    char const *key = key_buffer;
+    size_t key_len;
     char values[512];
+    size_t values_len;
+    char timestamp[32];
+    size_t timestamp_len;
     size_t message_len;
-    char message[1024];
 
-    if ((flags & GRAPHITE_ALWAYS_APPEND_DS) || (ds->ds_num > 1))
-      ds_name = ds->ds[i].name;
+    gr_cache_entry_t *e = NULL;
+    uint64_t hash = 0;
+    if (cache != NULL) {
+      hash = gr_cache_hash(vl_hash, i);
+      e = gr_cache_get(cache, hash, i, vl);
+    }
 
-    /* Copy the identifier to `key' and escape it. */
-    if (flags & GRAPHITE_USE_TAGS) {
-      status = gr_format_name_tagged(key, sizeof(key), vl, ds_name, prefix,
-                                     postfix, escape_char, flags);
-      if (status != 0) {
-        P_ERROR("format_graphite: error with gr_format_name_tagged");
-        sfree(rates);
-        return status;
-      }
+    if (e != NULL) {
+      key = e->name;
+      key_len = e->name_len;
     } else {
-      status = gr_format_name(key, sizeof(key), vl, ds_name, prefix, postfix,
-                              escape_char, flags);
+      status = gr_format_key(key_buffer, sizeof(key_buffer), ds, vl, i, prefix,
+                             postfix, escape_char, flags);
       if (status != 0) {
-        P_ERROR("format_graphite: error with gr_format_name");
-        sfree(rates);
+        sfree(rates_alloc);
         return status;
       }
-    }
+      key_len = strlen(key_buffer);
 
-    escape_graphite_string(key, escape_char);
+      if (cache != NULL)
+        gr_cache_add(cache, hash, i, vl, key_buffer, key_len);
+    }
 
     /* Convert the values to an ASCII representation and put that into
      * `values'. */
     status = gr_format_values(values, sizeof(values), i, ds, vl, rates);
     if (status != 0) {
       P_ERROR("format_graphite: error with gr_format_values");
-      sfree(rates);
+      sfree(rates_alloc);
       return status;
     }
+    values_len = strlen(values);
+
+    timestamp_len = (size_t)format_uint64(
+        timestamp, sizeof(timestamp),
+        (uint64_t)(unsigned int)CDTIME_T_TO_TIME_T(vl->time));
 
-    /* Compute the graphite command */
-    message_len =
-        (size_t)snprintf(message, sizeof(message), "%s %s %u\r\n", key, values,
-                         (unsigned int)CDTIME_T_TO_TIME_T(vl->time));
-    if (message_len >= sizeof(message)) {
+    /* Compute the graphite command: "<key> <values> <timestamp>\r\n" */
+    message_len = key_len + 1 + values_len + 1 + timestamp_len + 2;
+    if (message_len >= 1024) {
       P_ERROR("format_graphite: message buffer too small: "
               "Need %" PRIsz " bytes.",
               message_len + 1);
-      sfree(rates);
+      sfree(rates_alloc);
       return -ENOMEM;
     }
 
     /* Append it in case we got multiple data set */
     if ((buffer_pos + message_len) >= buffer_size) {
       P_ERROR("format_graphite: target buffer too small");
-      sfree(rates);
+      sfree(rates_alloc);
       return -ENOMEM;
     }
-    memcpy((void *)(buffer + buffer_pos), message, message_len);
+
+    char *ptr = buffer + buffer_pos;
+    memcpy(ptr, key, key_len);
+    ptr += key_len;
+    *(ptr++) = ' ';
+    memcpy(ptr, values, values_len);
+    ptr += values_len;
+    *(ptr++) = ' ';
+    memcpy(ptr, timestamp, timestamp_len);
+    ptr += timestamp_len;
+    memcpy(ptr, "\r\n", 3);
     buffer_pos += message_len;
-    buffer[buffer_pos] = '\0';
   }
-  sfree(rates);
+  sfree(rates_alloc);
   return status;
-} /* int format_graphite */
+} /* int format_graphite_cached */
@@ -39,4 +39,21 @@ int format_graphite(char *buffer, size_t buffer_size, const data_set_t *ds,
                     const char *postfix, const char escape_char,
                     unsigned int flags);
 
+/* A cache of escaped metric names, keyed by identifier and data source and
+ * bounded to "max_entries" by evicting the least recently used name. The
+ * names depend on the prefix, postfix, escape character and flags, so a
+ * cache must only be used with one set of those, e.g. one per write
+ * callback. It is not thread-safe; callers have to serialize its use. */
+typedef struct graphite_cache_s graphite_cache_t;
+
+graphite_cache_t *graphite_cache_create(size_t max_entries);
+void graphite_cache_destroy(graphite_cache_t *cache);
+
+/* Like format_graphite(), but looks names up in "cache" if it is not NULL. */
+int format_graphite_cached(char *buffer, size_t buffer_size,
+                           const data_set_t *ds, const value_list_t *vl,
+                           const char *prefix, const char *postfix,
+                           const char escape_char, unsigned int flags,
+                           graphite_cache_t *cache);
+
 #endif /* UTILS_FORMAT_GRAPHITE_H */
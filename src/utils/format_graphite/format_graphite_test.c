@@ -87,6 +87,19 @@ DEF_TEST(metric_name) {
           .type_instance = "test,123,",
           .want_name = "example@com.test-foo@@test@.single-test@123@",
       },
+      /* long names, with special chars on both sides of 16 byte blocks */
+      {
+          .plugin_instance = "a_long_plugin_instance_name_over_32",
+          .type_instance = "0123456789abcdef.0123456789abcde f\tx",
+          .want_name = "example@com.test-a_long_plugin_instance_name_over_32."
+                       "single-0123456789abcdef@0123456789abcde@f@x",
+      },
+      {
+          .plugin_instance = "caf\xc3\xa9-0123456789abcdef",
+          .type_instance = "0123456789abcdef0123456789abcde\x7f",
+          .want_name = "example@com.test-caf\xc3\xa9-0123456789abcdef."
+                       "single-0123456789abcdef0123456789abcde@",
+      },
       /* flag GRAPHITE_SEPARATE_INSTANCES */
       {
           .plugin_instance = "foo",
@@ -114,6 +127,13 @@ DEF_TEST(metric_name) {
           .flags = GRAPHITE_PRESERVE_SEPARATOR,
           .want_name = "example.com.test-f.o.o.single-b.a.r",
       },
+      {
+          .plugin_instance = "f.o.o.0123456789abcdef.0123456789",
+          .type_instance = "b a r.0123456789abcdef.0123456789",
+          .flags = GRAPHITE_PRESERVE_SEPARATOR,
+          .want_name = "example.com.test-f.o.o.0123456789abcdef.0123456789."
+                       "single-b@a@r.0123456789abcdef.0123456789",
+      },
       /* prefix and suffix */
       {
           .prefix = "foo.",
@@ -174,6 +194,18 @@ DEF_TEST(metric_name) {
                                      cases[i].prefix, cases[i].suffix, '@',
                                      cases[i].flags));
     EXPECT_EQ_STR(want, got);
+
+    /* The second call with a cache uses the cached name. */
+    graphite_cache_t *cache = graphite_cache_create(4);
+    CHECK_NOT_NULL(cache);
+    for (int j = 0; j < 2; j++) {
+      EXPECT_EQ_INT(0, format_graphite_cached(got, sizeof(got), &ds_single,
+                                              &vl, cases[i].prefix,
+                                              cases[i].suffix, '@',
+                                              cases[i].flags, cache));
+      EXPECT_EQ_STR(want, got);
+    }
+    graphite_cache_destroy(cache);
   }
 
   return 0;
@@ -205,9 +237,54 @@ DEF_TEST(null_termination) {
   return 0;
 }
 
+DEF_TEST(name_cache) {
+  data_set_t ds_double = {
+      .type = "double",
+      .ds_num = 2,
+      .ds =
+          (data_source_t[]){
+              {"one", DS_TYPE_GAUGE, NAN, NAN},
+              {"two", DS_TYPE_GAUGE, NAN, NAN},
+          },
+  };
+  value_list_t vl = {
+      .values = (value_t[]){{.gauge = 1}, {.gauge = 2}},
+      .values_len = 2,
+      .time = TIME_T_TO_CDTIME_T_STATIC(1480063672),
+      .interval = TIME_T_TO_CDTIME_T_STATIC(10),
+      .host = "example.com",
+      .plugin = "test",
+      .type = "double",
+  };
+  char const *instances[] = {"a", "b", "c", "a", "c", "b"};
+
+  /* Three identifiers with two data sources each compete for three slots. */
+  graphite_cache_t *cache = graphite_cache_create(3);
+  CHECK_NOT_NULL(cache);
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(instances); i++) {
+    char want[1024];
+    char got[1024];
+
+    sstrncpy(vl.type_instance, instances[i], sizeof(vl.type_instance));
+    ssnprintf(want, sizeof(want),
+              "example_com.test.double-%s.one 1 1480063672\r\n"
+              "example_com.test.double-%s.two 2 1480063672\r\n",
+              instances[i], instances[i]);
+
+    EXPECT_EQ_INT(0, format_graphite_cached(got, sizeof(got), &ds_double, &vl,
+                                            NULL, NULL, '_', 0, cache));
+    EXPECT_EQ_STR(want, got);
+  }
+
+  graphite_cache_destroy(cache);
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(metric_name);
   RUN_TEST(null_termination);
+  RUN_TEST(name_cache);
 
   END_TEST;
 }
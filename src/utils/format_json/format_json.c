@@ -30,8 +30,17 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/strbuf/strbuf.h"
 #include "utils_cache.h"
 
+#if defined(__SSE2__) && !defined(__CHAR_UNSIGNED__)
+#include <emmintrin.h>
+#define JSON_ESCAPE_SSE2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON) && defined(__CHAR_UNSIGNED__)
+#include <arm_neon.h>
+#define JSON_ESCAPE_NEON 1
+#endif
+
 #if HAVE_LIBYAJL
 #include <yajl/yajl_common.h>
 #include <yajl/yajl_gen.h>
@@ -43,130 +52,168 @@
 #endif
 #endif
 
-static int json_escape_string(char *buffer, size_t buffer_size, /* {{{ */
-                              const char *string) {
-  size_t dst_pos;
+/* Note that "c <= 0x1F" is also true for bytes >= 0x80 where char is signed;
+ * the vector paths below are only used where they reproduce that. */
+static bool json_needs_escape(char c) {
+  return (c == '"') || (c == '\\') || (c <= 0x001F);
+} /* bool json_needs_escape */
 
-  if ((buffer == NULL) || (string == NULL))
-    return -EINVAL;
+/* Returns the length of the leading run of "string" (of length "len") that
+ * can be copied without escaping. */
+static size_t json_clean_run(const char *string, size_t len) /* {{{ */
+{
+  size_t i = 0;
+
+#if JSON_ESCAPE_SSE2
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i space = _mm_set1_epi8(0x20);
+
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(string + i));
+    __m128i bad = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+        _mm_cmplt_epi8(v, space));
+
+    int mask = _mm_movemask_epi8(bad);
+    if (mask != 0)
+      return i + (size_t)__builtin_ctz((unsigned int)mask);
+  }
+#elif JSON_ESCAPE_NEON
+  const uint8x16_t quote = vdupq_n_u8('"');
+  const uint8x16_t backslash = vdupq_n_u8('\\');
+  const uint8x16_t space = vdupq_n_u8(0x20);
+
+  for (; i + 16 <= len; i += 16) {
+    uint8x16_t v = vld1q_u8((const uint8_t *)(string + i));
+    uint8x16_t bad =
+        vorrq_u8(vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, backslash)),
+                 vcltq_u8(v, space));
+
+    if (vmaxvq_u8(bad) != 0)
+      break; /* the loop below finds the exact position */
+  }
+#endif
 
-  if (buffer_size < 3)
-    return -ENOMEM;
+  while ((i < len) && !json_needs_escape(string[i]))
+    i++;
+  return i;
+} /* }}} size_t json_clean_run */
 
-  dst_pos = 0;
+/* Appends "string" to "buf" as a quoted JSON string. Runs that need no
+ * escaping are copied as a whole. */
+static int json_escape_string(strbuf_t *buf, const char *string) /* {{{ */
+{
+  if ((buf == NULL) || (string == NULL))
+    return -EINVAL;
 
-#define BUFFER_ADD(c)                                                          \
-  do {                                                                         \
-    if (dst_pos >= (buffer_size - 1)) {                                        \
-      buffer[buffer_size - 1] = '\0';                                          \
-      return -ENOMEM;                                                          \
-    }                                                                          \
-    buffer[dst_pos] = (c);                                                     \
-    dst_pos++;                                                                 \
-  } while (0)
+  size_t src_len = strlen(string);
 
-  /* Escape special characters */
-  BUFFER_ADD('"');
-  for (size_t src_pos = 0; string[src_pos] != 0; src_pos++) {
-    if ((string[src_pos] == '"') || (string[src_pos] == '\\')) {
-      BUFFER_ADD('\\');
-      BUFFER_ADD(string[src_pos]);
-    } else if (string[src_pos] <= 0x001F)
-      BUFFER_ADD('?');
+  if (strbuf_printn(buf, "\"", 1) != 0)
+    return -ENOMEM;
+  for (size_t src_pos = 0; src_pos < src_len; src_pos++) {
+    size_t run = json_clean_run(string + src_pos, src_len - src_pos);
+    if (run > 0) {
+      if (strbuf_printn(buf, string + src_pos, run) != 0)
+        return -ENOMEM;
+      src_pos += run;
+      if (src_pos >= src_len)
+        break;
+    }
+
+    char esc[2] = {'\\', string[src_pos]};
+    int status;
+    if ((string[src_pos] == '"') || (string[src_pos] == '\\'))
+      status = strbuf_printn(buf, esc, sizeof(esc));
     else
-      BUFFER_ADD(string[src_pos]);
+      status = strbuf_printn(buf, "?", 1);
+    if (status != 0)
+      return -ENOMEM;
   } /* for */
-  BUFFER_ADD('"');
-  buffer[dst_pos] = 0;
-
-#undef BUFFER_ADD
+  if (strbuf_printn(buf, "\"", 1) != 0)
+    return -ENOMEM;
 
   return 0;
 } /* }}} int json_escape_string */
 
-static int values_to_json(char *buffer, size_t buffer_size, /* {{{ */
-                          const data_set_t *ds, const value_list_t *vl,
-                          int store_rates) {
-  size_t offset = 0;
-  gauge_t *rates = NULL;
-
-  memset(buffer, 0, buffer_size);
-
 #define BUFFER_ADD(...)                                                        \
   do {                                                                         \
-    int status;                                                                \
-    status = snprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);     \
-    if (status < 1) {                                                          \
-      sfree(rates);                                                            \
-      return -1;                                                               \
-    } else if (((size_t)status) >= (buffer_size - offset)) {                   \
-      sfree(rates);                                                            \
+    if (strbuf_printf(buf, __VA_ARGS__) != 0)                                  \
       return -ENOMEM;                                                          \
-    } else                                                                     \
-      offset += ((size_t)status);                                              \
   } while (0)
 
-  BUFFER_ADD("[");
+static int values_to_json(strbuf_t *buf, const data_set_t *ds, /* {{{ */
+                          const value_list_t *vl, int store_rates) {
+  gauge_t const *rates = NULL;
+  gauge_t *rates_alloc = NULL;
+  int status = 0;
+
+#define BUFFER_ADD_STR(str)                                                    \
+  do {                                                                         \
+    if (strbuf_print(buf, (str)) != 0) {                                       \
+      status = -ENOMEM;                                                        \
+      goto out;                                                                \
+    }                                                                          \
+  } while (0)
+
+#define BUFFER_ADD_VALUE(func, value)                                          \
+  do {                                                                         \
+    char tmp[64];                                                              \
+    int len = func(tmp, sizeof(tmp), value);                                   \
+    if ((len < 1) || ((size_t)len >= sizeof(tmp)) ||                           \
+        (strbuf_printn(buf, tmp, (size_t)len) != 0)) {                         \
+      status = -ENOMEM;                                                        \
+      goto out;                                                                \
+    }                                                                          \
+  } while (0)
+
+  BUFFER_ADD_STR("[");
   for (size_t i = 0; i < ds->ds_num; i++) {
     if (i > 0)
-      BUFFER_ADD(",");
+      BUFFER_ADD_STR(",");
 
     if (ds->ds[i].type == DS_TYPE_GAUGE) {
       if (isfinite(vl->values[i].gauge))
-        BUFFER_ADD(JSON_GAUGE_FORMAT, vl->values[i].gauge);
+        BUFFER_ADD_VALUE(format_gauge, vl->values[i].gauge);
       else
-        BUFFER_ADD("null");
+        BUFFER_ADD_STR("null");
     } else if (store_rates) {
       if (rates == NULL)
-        rates = uc_get_rate(ds, vl);
+        rates = uc_get_rate_attached(ds, vl, &rates_alloc);
       if (rates == NULL) {
-        WARNING("utils_format_json: uc_get_rate failed.");
-        sfree(rates);
-        return -1;
+        WARNING("utils_format_json: uc_get_rate_attached failed.");
+        status = -1;
+        goto out;
       }
 
       if (isfinite(rates[i]))
-        BUFFER_ADD(JSON_GAUGE_FORMAT, rates[i]);
+        BUFFER_ADD_VALUE(format_gauge, rates[i]);
       else
-        BUFFER_ADD("null");
+        BUFFER_ADD_STR("null");
     } else if (ds->ds[i].type == DS_TYPE_COUNTER)
-      BUFFER_ADD("%" PRIu64, (uint64_t)vl->values[i].counter);
+      BUFFER_ADD_VALUE(format_uint64, (uint64_t)vl->values[i].counter);
     else if (ds->ds[i].type == DS_TYPE_DERIVE)
-      BUFFER_ADD("%" PRIi64, vl->values[i].derive);
+      BUFFER_ADD_VALUE(format_int64, vl->values[i].derive);
     else if (ds->ds[i].type == DS_TYPE_ABSOLUTE)
-      BUFFER_ADD("%" PRIu64, vl->values[i].absolute);
+      BUFFER_ADD_VALUE(format_uint64, vl->values[i].absolute);
     else {
       ERROR("format_json: Unknown data source type: %i", ds->ds[i].type);
-      sfree(rates);
-      return -1;
+      status = -1;
+      goto out;
     }
   } /* for ds->ds_num */
-  BUFFER_ADD("]");
+  BUFFER_ADD_STR("]");
 
-#undef BUFFER_ADD
+#undef BUFFER_ADD_VALUE
+#undef BUFFER_ADD_STR
 
-  sfree(rates);
-  return 0;
+out:
+  sfree(rates_alloc);
+  return status;
 } /* }}} int values_to_json */
 
-static int dstypes_to_json(char *buffer, size_t buffer_size, /* {{{ */
-                           const data_set_t *ds) {
-  size_t offset = 0;
-
-  memset(buffer, 0, buffer_size);
-
-#define BUFFER_ADD(...)                                                        \
-  do {                                                                         \
-    int status;                                                                \
-    status = snprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);     \
-    if (status < 1)                                                            \
-      return -1;                                                               \
-    else if (((size_t)status) >= (buffer_size - offset))                       \
-      return -ENOMEM;                                                          \
-    else                                                                       \
-      offset += ((size_t)status);                                              \
-  } while (0)
-
+static int dstypes_to_json(strbuf_t *buf, const data_set_t *ds) /* {{{ */
+{
   BUFFER_ADD("[");
   for (size_t i = 0; i < ds->ds_num; i++) {
     if (i > 0)
@@ -176,29 +223,11 @@ static int dstypes_to_json(char *buffer, size_t buffer_size, /* {{{ */
   } /* for ds->ds_num */
   BUFFER_ADD("]");
 
-#undef BUFFER_ADD
-
   return 0;
 } /* }}} int dstypes_to_json */
 
-static int dsnames_to_json(char *buffer, size_t buffer_size, /* {{{ */
-                           const data_set_t *ds) {
-  size_t offset = 0;
-
-  memset(buffer, 0, buffer_size);
-
-#define BUFFER_ADD(...)                                                        \
-  do {                                                                         \
-    int status;                                                                \
-    status = snprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);     \
-    if (status < 1)                                                            \
-      return -1;                                                               \
-    else if (((size_t)status) >= (buffer_size - offset))                       \
-      return -ENOMEM;                                                          \
-    else                                                                       \
-      offset += ((size_t)status);                                              \
-  } while (0)
-
+static int dsnames_to_json(strbuf_t *buf, const data_set_t *ds) /* {{{ */
+{
   BUFFER_ADD("[");
   for (size_t i = 0; i < ds->ds_num; i++) {
     if (i > 0)
@@ -208,30 +237,15 @@ static int dsnames_to_json(char *buffer, size_t buffer_size, /* {{{ */
   } /* for ds->ds_num */
   BUFFER_ADD("]");
 
-#undef BUFFER_ADD
-
   return 0;
 } /* }}} int dsnames_to_json */
 
-static int meta_data_keys_to_json(char *buffer, size_t buffer_size, /* {{{ */
+static int meta_data_keys_to_json(strbuf_t *buf, /* {{{ */
                                   meta_data_t *meta, char **keys,
                                   size_t keys_num) {
-  size_t offset = 0;
+  size_t start = buf->pos;
   int status;
 
-  buffer[0] = 0;
-
-#define BUFFER_ADD(...)                                                        \
-  do {                                                                         \
-    status = snprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);     \
-    if (status < 1)                                                            \
-      return -1;                                                               \
-    else if (((size_t)status) >= (buffer_size - offset))                       \
-      return -ENOMEM;                                                          \
-    else                                                                       \
-      offset += ((size_t)status);                                              \
-  } while (0)
-
   for (size_t i = 0; i < keys_num; ++i) {
     int type;
     char *key = keys[i];
@@ -240,14 +254,14 @@ static int meta_data_keys_to_json(char *buffer, size_t buffer_size, /* {{{ */
     if (type == MD_TYPE_STRING) {
       char *value = NULL;
       if (meta_data_get_string(meta, key, &value) == 0) {
-        char temp[512] = "";
-
-        status = json_escape_string(temp, sizeof(temp), value);
+        if (strbuf_printf(buf, ",\"%s\":", key) != 0) {
+          sfree(value);
+          return -ENOMEM;
+        }
+        status = json_escape_string(buf, value);
         sfree(value);
         if (status != 0)
           return status;
-
-        BUFFER_ADD(",\"%s\":%s", key, temp);
       }
     } else if (type == MD_TYPE_SIGNED_INT) {
       int64_t value = 0;
@@ -268,32 +282,30 @@ static int meta_data_keys_to_json(char *buffer, size_t buffer_size, /* {{{ */
     }
   } /* for (keys) */
 
-  if (offset == 0)
+  if (buf->pos == start)
     return ENOENT;
 
-  buffer[0] = '{'; /* replace leading ',' */
+  buf->ptr[start] = '{'; /* replace leading ',' */
   BUFFER_ADD("}");
 
-#undef BUFFER_ADD
-
   return 0;
 } /* }}} int meta_data_keys_to_json */
 
-static int meta_data_to_json(char *buffer, size_t buffer_size, /* {{{ */
-                             meta_data_t *meta) {
+static int meta_data_to_json(strbuf_t *buf, meta_data_t *meta) /* {{{ */
+{
   char **keys = NULL;
   size_t keys_num;
   int status;
 
-  if ((buffer == NULL) || (buffer_size == 0) || (meta == NULL))
+  if ((buf == NULL) || (meta == NULL))
     return EINVAL;
 
   status = meta_data_toc(meta, &keys);
   if (status <= 0)
-    return status;
+    return (status == 0) ? ENOENT : status;
   keys_num = (size_t)status;
 
-  status = meta_data_keys_to_json(buffer, buffer_size, meta, keys, keys_num);
+  status = meta_data_keys_to_json(buf, meta, keys, keys_num);
 
   for (size_t i = 0; i < keys_num; ++i)
     sfree(keys[i]);
@@ -302,54 +314,38 @@ static int meta_data_to_json(char *buffer, size_t buffer_size, /* {{{ */
   return status;
 } /* }}} int meta_data_to_json */
 
-static int value_list_to_json(char *buffer, size_t buffer_size, /* {{{ */
+static int value_list_to_json(strbuf_t *buf, /* {{{ */
                               const data_set_t *ds, const value_list_t *vl,
                               int store_rates) {
-  char temp[512];
-  size_t offset = 0;
   int status;
 
-  memset(buffer, 0, buffer_size);
-
-#define BUFFER_ADD(...)                                                        \
-  do {                                                                         \
-    status = snprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);     \
-    if (status < 1)                                                            \
-      return -1;                                                               \
-    else if (((size_t)status) >= (buffer_size - offset))                       \
-      return -ENOMEM;                                                          \
-    else                                                                       \
-      offset += ((size_t)status);                                              \
-  } while (0)
-
   /* All value lists have a leading comma. The first one will be replaced with
    * a square bracket in `format_json_finalize'. */
-  BUFFER_ADD(",{");
+  BUFFER_ADD(",{\"values\":");
 
-  status = values_to_json(temp, sizeof(temp), ds, vl, store_rates);
+  status = values_to_json(buf, ds, vl, store_rates);
   if (status != 0)
     return status;
-  BUFFER_ADD("\"values\":%s", temp);
 
-  status = dstypes_to_json(temp, sizeof(temp), ds);
+  BUFFER_ADD(",\"dstypes\":");
+  status = dstypes_to_json(buf, ds);
   if (status != 0)
     return status;
-  BUFFER_ADD(",\"dstypes\":%s", temp);
 
-  status = dsnames_to_json(temp, sizeof(temp), ds);
+  BUFFER_ADD(",\"dsnames\":");
+  status = dsnames_to_json(buf, ds);
   if (status != 0)
     return status;
-  BUFFER_ADD(",\"dsnames\":%s", temp);
 
   BUFFER_ADD(",\"time\":%.3f", CDTIME_T_TO_DOUBLE(vl->time));
   BUFFER_ADD(",\"interval\":%.3f", CDTIME_T_TO_DOUBLE(vl->interval));
 
 #define BUFFER_ADD_KEYVAL(key, value)                                          \
   do {                                                                         \
-    status = json_escape_string(temp, sizeof(temp), (value));                  \
+    BUFFER_ADD(",\"%s\":", (key));                                             \
+    status = json_escape_string(buf, (value));                                 \
     if (status != 0)                                                           \
       return status;                                                           \
-    BUFFER_ADD(",\"%s\":%s", (key), temp);                                     \
   } while (0)
 
   BUFFER_ADD_KEYVAL("host", vl->host);
@@ -359,43 +355,52 @@ static int value_list_to_json(char *buffer, size_t buffer_size, /* {{{ */
   BUFFER_ADD_KEYVAL("type_instance", vl->type_instance);
 
   if (vl->meta != NULL) {
-    char meta_buffer[buffer_size];
-    memset(meta_buffer, 0, sizeof(meta_buffer));
-    status = meta_data_to_json(meta_buffer, sizeof(meta_buffer), vl->meta);
-    if (status != 0)
-      return status;
+    size_t meta_start = buf->pos;
 
-    BUFFER_ADD(",\"meta\":%s", meta_buffer);
+    BUFFER_ADD(",\"meta\":");
+    status = meta_data_to_json(buf, vl->meta);
+    if (status == ENOENT) /* no meta data to add */
+      strbuf_truncate(buf, meta_start);
+    else if (status != 0)
+      return status;
   } /* if (vl->meta != NULL) */
 
   BUFFER_ADD("}");
 
 #undef BUFFER_ADD_KEYVAL
-#undef BUFFER_ADD
 
   return 0;
 } /* }}} int value_list_to_json */
 
-static int format_json_value_list_nocheck(char *buffer, /* {{{ */
-                                          size_t *ret_buffer_fill,
-                                          size_t *ret_buffer_free,
-                                          const data_set_t *ds,
-                                          const value_list_t *vl,
-                                          int store_rates, size_t temp_size) {
-  char temp[temp_size];
-  int status;
+#undef BUFFER_ADD
+
+int format_json_value_list_strbuf(strbuf_t *buf, /* {{{ */
+                                  const data_set_t *ds, const value_list_t *vl,
+                                  int store_rates) {
+  if ((buf == NULL) || (ds == NULL) || (vl == NULL))
+    return -EINVAL;
 
-  status = value_list_to_json(temp, sizeof(temp), ds, vl, store_rates);
+  size_t pos = buf->pos;
+  int status = value_list_to_json(buf, ds, vl, store_rates);
   if (status != 0)
-    return status;
-  temp_size = strlen(temp);
+    strbuf_truncate(buf, pos);
+
+  return status;
+} /* }}} int format_json_value_list_strbuf */
 
-  memcpy(buffer + (*ret_buffer_fill), temp, temp_size + 1);
-  (*ret_buffer_fill) += temp_size;
-  (*ret_buffer_free) -= temp_size;
+int format_json_finalize_strbuf(strbuf_t *buf) /* {{{ */
+{
+  /* Replace the leading comma added in `value_list_to_json' with a square
+   * bracket. */
+  if ((buf == NULL) || (buf->pos == 0) || (buf->ptr[0] != ','))
+    return -EINVAL;
+
+  if (strbuf_print(buf, "]") != 0)
+    return -ENOMEM;
+  buf->ptr[0] = '[';
 
   return 0;
-} /* }}} int format_json_value_list_nocheck */
+} /* }}} int format_json_finalize_strbuf */
 
 int format_json_initialize(char *buffer, /* {{{ */
                            size_t *ret_buffer_fill, size_t *ret_buffer_free) {
@@ -415,7 +420,7 @@ int format_json_initialize(char *buffer, /* {{{ */
   if (buffer_free < 3)
     return -ENOMEM;
 
-  memset(buffer, 0, buffer_free);
+  buffer[0] = 0;
   *ret_buffer_fill = buffer_fill;
   *ret_buffer_free = buffer_free;
 
@@ -460,9 +465,18 @@ int format_json_value_list(char *buffer, /* {{{ */
   if (*ret_buffer_free < 3)
     return -ENOMEM;
 
-  return format_json_value_list_nocheck(buffer, ret_buffer_fill,
-                                        ret_buffer_free, ds, vl, store_rates,
-                                        (*ret_buffer_free) - 2);
+  /* Leave room for the closing bracket added by `format_json_finalize'. */
+  size_t buffer_size = *ret_buffer_fill + *ret_buffer_free;
+  strbuf_t buf = STRBUF_CREATE_FIXED(buffer, buffer_size - 2);
+  buf.pos = *ret_buffer_fill;
+
+  int status = format_json_value_list_strbuf(&buf, ds, vl, store_rates);
+  if (status != 0)
+    return status;
+
+  *ret_buffer_fill = buf.pos;
+  *ret_buffer_free = buffer_size - buf.pos;
+  return 0;
 } /* }}} int format_json_value_list */
 
 #if HAVE_LIBYAJL
@@ -30,6 +30,7 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/strbuf/strbuf.h"
 
 #ifndef JSON_GAUGE_FORMAT
 #define JSON_GAUGE_FORMAT GAUGE_FORMAT
@@ -42,6 +43,14 @@ int format_json_value_list(char *buffer, size_t *ret_buffer_fill,
                            const value_list_t *vl, int store_rates);
 int format_json_finalize(char *buffer, size_t *ret_buffer_fill,
                          size_t *ret_buffer_free);
+
+/* Variants appending to a string buffer. With a dynamic buffer these only
+ * fail if memory cannot be allocated, so callers don't need to handle a full
+ * buffer. On failure the buffer is left unchanged. */
+int format_json_value_list_strbuf(strbuf_t *buf, const data_set_t *ds,
+                                  const value_list_t *vl, int store_rates);
+int format_json_finalize_strbuf(strbuf_t *buf);
+
 int format_json_notification(char *buffer, size_t buffer_size,
                              notification_t const *n);
 
@@ -177,8 +177,58 @@ DEF_TEST(notification) {
   return expect_json_labels(got, labels, STATIC_ARRAY_SIZE(labels));
 }
 
+DEF_TEST(value_list) {
+  data_source_t dsrc[] = {
+      {"rx", DS_TYPE_DERIVE, 0, NAN},
+      {"tx", DS_TYPE_GAUGE, 0, NAN},
+  };
+  data_set_t ds = {"if_octets", STATIC_ARRAY_SIZE(dsrc), dsrc};
+  value_t values[] = {{.derive = -42}, {.gauge = 3.25}};
+  value_list_t vl = {
+      .values = values,
+      .values_len = STATIC_ARRAY_SIZE(values),
+      .time = TIME_T_TO_CDTIME_T(1480063672),
+      .interval = TIME_T_TO_CDTIME_T(10),
+      .host = "example.com",
+      .plugin = "interface",
+      .type = "if_octets",
+      .type_instance = "eth\\\"0\"",
+  };
+  char const *want_one =
+      "{\"values\":[-42,3.25],\"dstypes\":[\"derive\",\"gauge\"],"
+      "\"dsnames\":[\"rx\",\"tx\"],\"time\":1480063672.000,"
+      "\"interval\":10.000,\"host\":\"example.com\","
+      "\"plugin\":\"interface\",\"plugin_instance\":\"\","
+      "\"type\":\"if_octets\",\"type_instance\":\"eth\\\\\\\"0\\\"\"}";
+  char want[1024];
+  snprintf(want, sizeof(want), "[%s,%s]", want_one, want_one);
+
+  strbuf_t buf = STRBUF_CREATE;
+  for (int i = 0; i < 2; i++)
+    CHECK_ZERO(format_json_value_list_strbuf(&buf, &ds, &vl, 0));
+  CHECK_ZERO(format_json_finalize_strbuf(&buf));
+  EXPECT_EQ_STR(want, buf.ptr);
+  STRBUF_DESTROY(buf);
+
+  /* fixed size buffer: the second value list does not fit */
+  char got[384];
+  size_t fill = 0;
+  size_t bfree = sizeof(got);
+  CHECK_ZERO(format_json_initialize(got, &fill, &bfree));
+  CHECK_ZERO(format_json_value_list(got, &fill, &bfree, &ds, &vl, 0));
+  EXPECT_EQ_INT(-ENOMEM,
+                format_json_value_list(got, &fill, &bfree, &ds, &vl, 0));
+  CHECK_ZERO(format_json_finalize(got, &fill, &bfree));
+  snprintf(want, sizeof(want), "[%s]", want_one);
+  EXPECT_EQ_STR(want, got);
+  EXPECT_EQ_UINT64(strlen(want), fill);
+
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(notification);
+  RUN_TEST(value_list);
 
   END_TEST;
 }
@@ -30,20 +30,20 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/strbuf/strbuf.h"
 
 #ifndef JSON_GAUGE_FORMAT
 #define JSON_GAUGE_FORMAT GAUGE_FORMAT
 #endif
 
-int format_kairosdb_initialize(char *buffer, size_t *ret_buffer_fill,
-                               size_t *ret_buffer_free);
-int format_kairosdb_value_list(char *buffer, size_t *ret_buffer_fill,
-                               size_t *ret_buffer_free, const data_set_t *ds,
+/* Appends the value list to "buf". All value lists have a leading comma,
+ * which format_kairosdb_finalize() replaces with an opening bracket. On
+ * failure the buffer is left unchanged. */
+int format_kairosdb_value_list(strbuf_t *buf, const data_set_t *ds,
                                const value_list_t *vl, int store_rates,
                                char const *const *http_attrs,
                                size_t http_attrs_num, int data_ttl,
                                char const *metrics_prefix);
-int format_kairosdb_finalize(char *buffer, size_t *ret_buffer_fill,
-                             size_t *ret_buffer_free);
+int format_kairosdb_finalize(strbuf_t *buf);
 
 #endif /* UTILS_FORMAT_KAIROSDB_H */
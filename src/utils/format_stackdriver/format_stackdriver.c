@@ -145,16 +145,16 @@ static int format_typed_value(yajl_gen gen, int ds_type, value_t v,
   }
   case DS_TYPE_DERIVE: {
     derive_t diff = v.derive - (derive_t)start_value;
-    ssnprintf(integer, sizeof(integer), "%" PRIi64, diff);
+    format_int64(integer, sizeof(integer), diff);
     break;
   }
   case DS_TYPE_COUNTER: {
     counter_t diff = counter_diff((counter_t)start_value, v.counter);
-    ssnprintf(integer, sizeof(integer), "%llu", diff);
+    format_uint64(integer, sizeof(integer), (uint64_t)diff);
     break;
   }
   case DS_TYPE_ABSOLUTE: {
-    ssnprintf(integer, sizeof(integer), "%" PRIu64, v.absolute);
+    format_uint64(integer, sizeof(integer), v.absolute);
     break;
   }
   default: {
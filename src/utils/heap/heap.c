@@ -1,6 +1,7 @@
 /**
  * collectd - src/utils_heap.c
  * Copyright (C) 2009       Florian octo Forster
+ * Copyright (C) 2026       collectd.org
  *
  * Permission is hereby granted, free of charge, to any person obtaining a
  * copy of this software and associated documentation files (the "Software"),
@@ -30,6 +31,7 @@
 #include <errno.h>
 #include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "utils/heap/heap.h"
 
@@ -205,3 +207,167 @@ void *c_heap_get_root(c_heap_t *h) {
 
   return ret;
 } /* void *c_heap_get_root */
+
+void *c_heap_peek_root(c_heap_t *h) {
+  void *ret = NULL;
+
+  if (h == NULL)
+    return NULL;
+
+  pthread_mutex_lock(&h->lock);
+  if (h->list_len > 0)
+    ret = h->list[0];
+  pthread_mutex_unlock(&h->lock);
+
+  return ret;
+} /* void *c_heap_peek_root */
+
+/*
+ * Time heap
+ */
+#define TIMEHEAP_ARITY 4
+/* Padding in front of the array, so that sibling groups are aligned to
+ * TIMEHEAP_ALIGN (see c_timeheap_grow). */
+#define TIMEHEAP_PAD (TIMEHEAP_ARITY - 1)
+#define TIMEHEAP_ALIGN 64
+
+typedef struct {
+  uint64_t key;
+  void *ptr;
+} c_timeheap_entry_t;
+
+struct c_timeheap_s {
+  c_timeheap_entry_t *base; /* allocation */
+  c_timeheap_entry_t *list; /* base + TIMEHEAP_PAD */
+  size_t list_len;
+  size_t list_size;
+};
+
+static void timeheap_sift_up(c_timeheap_t *h, size_t i,
+                             c_timeheap_entry_t e) {
+  while (i > 0) {
+    size_t parent = (i - 1) / TIMEHEAP_ARITY;
+    if (h->list[parent].key <= e.key)
+      break;
+    h->list[i] = h->list[parent];
+    i = parent;
+  }
+  h->list[i] = e;
+} /* void timeheap_sift_up */
+
+static void timeheap_sift_down(c_timeheap_t *h, size_t i,
+                               c_timeheap_entry_t e) {
+  while (42) {
+    size_t first = (TIMEHEAP_ARITY * i) + 1;
+    if (first >= h->list_len)
+      break;
+
+    size_t last = first + TIMEHEAP_ARITY;
+    if (last > h->list_len)
+      last = h->list_len;
+
+    size_t min = first;
+    for (size_t c = first + 1; c < last; c++)
+      if (h->list[c].key < h->list[min].key)
+        min = c;
+
+    if (e.key <= h->list[min].key)
+      break;
+    h->list[i] = h->list[min];
+    i = min;
+  }
+  h->list[i] = e;
+} /* void timeheap_sift_down */
+
+/* With 16 byte entries, the four children of entry i, (4i+1) to (4i+4), fill
+ * exactly one 64 byte cache line if entry 1 starts on a cache line boundary.
+ * The array is therefore preceded by three unused entries. */
+static int timeheap_grow(c_timeheap_t *h) {
+  size_t size = (h->list_size == 0) ? 16 : 2 * h->list_size;
+  c_timeheap_entry_t *base;
+
+  if (posix_memalign((void **)&base, TIMEHEAP_ALIGN,
+                     (size + TIMEHEAP_PAD) * sizeof(*base)) != 0)
+    return -ENOMEM;
+
+  if (h->list_len > 0)
+    memcpy(base + TIMEHEAP_PAD, h->list, h->list_len * sizeof(*base));
+  free(h->base);
+
+  h->base = base;
+  h->list = base + TIMEHEAP_PAD;
+  h->list_size = size;
+  return 0;
+} /* int timeheap_grow */
+
+c_timeheap_t *c_timeheap_create(void) {
+  return calloc(1, sizeof(c_timeheap_t));
+} /* c_timeheap_t *c_timeheap_create */
+
+void c_timeheap_destroy(c_timeheap_t *h) {
+  if (h == NULL)
+    return;
+
+  free(h->base);
+  free(h);
+} /* void c_timeheap_destroy */
+
+int c_timeheap_insert(c_timeheap_t *h, uint64_t key, void *ptr) {
+  if ((h == NULL) || (ptr == NULL))
+    return -EINVAL;
+
+  if (h->list_len == h->list_size) {
+    int status = timeheap_grow(h);
+    if (status != 0)
+      return status;
+  }
+
+  h->list_len++;
+  timeheap_sift_up(h, h->list_len - 1,
+                   (c_timeheap_entry_t){.key = key, .ptr = ptr});
+  return 0;
+} /* int c_timeheap_insert */
+
+void *c_timeheap_peek_root(c_timeheap_t *h, uint64_t *key) {
+  if ((h == NULL) || (h->list_len == 0))
+    return NULL;
+
+  if (key != NULL)
+    *key = h->list[0].key;
+  return h->list[0].ptr;
+} /* void *c_timeheap_peek_root */
+
+void *c_timeheap_get_root(c_timeheap_t *h, uint64_t *key) {
+  if ((h == NULL) || (h->list_len == 0))
+    return NULL;
+
+  c_timeheap_entry_t root = h->list[0];
+
+  h->list_len--;
+  if (h->list_len > 0)
+    timeheap_sift_down(h, 0, h->list[h->list_len]);
+
+  if (key != NULL)
+    *key = root.key;
+  return root.ptr;
+} /* void *c_timeheap_get_root */
+
+void *c_timeheap_replace_root(c_timeheap_t *h, uint64_t key, void *ptr,
+                              uint64_t *rkey) {
+  if ((h == NULL) || (h->list_len == 0) || (ptr == NULL))
+    return NULL;
+
+  c_timeheap_entry_t root = h->list[0];
+
+  timeheap_sift_down(h, 0, (c_timeheap_entry_t){.key = key, .ptr = ptr});
+
+  if (rkey != NULL)
+    *rkey = root.key;
+  return root.ptr;
+} /* void *c_timeheap_replace_root */
+
+size_t c_timeheap_size(c_timeheap_t *h) {
+  if (h == NULL)
+    return 0;
+  return h->list_len;
+} /* size_t c_timeheap_size */
@@ -27,6 +27,9 @@
 #ifndef UTILS_HEAP_H
 #define UTILS_HEAP_H 1
 
+#include <stddef.h>
+#include <stdint.h>
+
 struct c_heap_s;
 typedef struct c_heap_s c_heap_t;
 
@@ -96,4 +99,114 @@ int c_heap_insert(c_heap_t *h, void *ptr);
  */
 void *c_heap_get_root(c_heap_t *h);
 
+/*
+ * NAME
+ *   c_heap_peek_root
+ * DESCRIPTION
+ *   Returns the value at the root of the heap without removing it. The
+ *   returned pointer may be removed by another thread at any time, so callers
+ *   that share the heap need to serialize c_heap_peek_root() and
+ *   c_heap_get_root() themselves.
+ * PARAMETERS
+ *   `h'           Heap to look at.
+ * RETURN VALUE
+ *   The pointer passed to `c_heap_insert' or NULL if the heap is empty (or an
+ *   error occurred).
+ */
+void *c_heap_peek_root(c_heap_t *h);
+
+/*
+ * The "time heap" is a 4-ary min-heap that stores a 64 bit key (typically a
+ * cdtime_t) next to each pointer, so that re-ordering the heap compares
+ * integers in the heap's own array instead of calling a callback on the
+ * stored objects. Groups of siblings share a cache line. Unlike c_heap_t it
+ * does no locking of its own: callers sharing a time heap between threads
+ * have to serialize all calls.
+ */
+struct c_timeheap_s;
+typedef struct c_timeheap_s c_timeheap_t;
+
+/*
+ * NAME
+ *   c_timeheap_create
+ *
+ * DESCRIPTION
+ *   Allocates a new, empty time heap.
+ *
+ * RETURN VALUE
+ *   A c_timeheap_t-pointer upon success or NULL upon failure.
+ */
+c_timeheap_t *c_timeheap_create(void);
+
+/*
+ * NAME
+ *   c_timeheap_destroy
+ *
+ * DESCRIPTION
+ *   Deallocates a time heap. Stored pointers are lost, but not freed.
+ */
+void c_timeheap_destroy(c_timeheap_t *h);
+
+/*
+ * NAME
+ *   c_timeheap_insert
+ *
+ * DESCRIPTION
+ *   Stores `ptr' in the heap, ordered by `key'. Entries with equal keys are
+ *   returned in no particular order.
+ *
+ * RETURN VALUE
+ *   Zero upon success, a negative errno value otherwise.
+ */
+int c_timeheap_insert(c_timeheap_t *h, uint64_t key, void *ptr);
+
+/*
+ * NAME
+ *   c_timeheap_peek_root
+ *
+ * DESCRIPTION
+ *   Returns the entry with the smallest key without removing it. If `key' is
+ *   not NULL, the entry's key is stored there.
+ *
+ * RETURN VALUE
+ *   The stored pointer or NULL if the heap is empty.
+ */
+void *c_timeheap_peek_root(c_timeheap_t *h, uint64_t *key);
+
+/*
+ * NAME
+ *   c_timeheap_get_root
+ *
+ * DESCRIPTION
+ *   Like c_timeheap_peek_root(), but also removes the entry from the heap.
+ */
+void *c_timeheap_get_root(c_timeheap_t *h, uint64_t *key);
+
+/*
+ * NAME
+ *   c_timeheap_replace_root
+ *
+ * DESCRIPTION
+ *   Removes the entry with the smallest key and stores `ptr' with `key' in
+ *   its place. This is equivalent to c_timeheap_get_root() followed by
+ *   c_timeheap_insert(), but re-orders the heap only once, which makes it the
+ *   cheapest way to re-schedule an entry and pick up the next one. If `rkey'
+ *   is not NULL, the removed entry's key is stored there.
+ *
+ * RETURN VALUE
+ *   The removed pointer, or NULL if the heap is empty. In that case the heap
+ *   is left unchanged and `ptr' is not inserted.
+ */
+void *c_timeheap_replace_root(c_timeheap_t *h, uint64_t key, void *ptr,
+                              uint64_t *rkey);
+
+/*
+ * NAME
+ *   c_timeheap_size
+ *
+ * DESCRIPTION
+ *   Returns the number of entries in the heap.
+ */
+size_t c_timeheap_size(c_timeheap_t *h);
+
 #endif /* UTILS_HEAP_H */
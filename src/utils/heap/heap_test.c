@@ -51,8 +51,9 @@ DEF_TEST(simple) {
 
   for (int i = 0; i < 5; i++) {
     int *ret = NULL;
-    CHECK_NOT_NULL(ret = c_heap_get_root(h));
+    CHECK_NOT_NULL(ret = c_heap_peek_root(h));
     OK(*ret == i);
+    EXPECT_EQ_PTR(ret, c_heap_get_root(h));
   }
 
   CHECK_ZERO(c_heap_insert(h, &values[6] /* = 0 */));
@@ -66,13 +67,73 @@ DEF_TEST(simple) {
     CHECK_NOT_NULL(ret = c_heap_get_root(h));
     OK(*ret == i);
   }
+  EXPECT_EQ_PTR(NULL, c_heap_peek_root(h));
 
   c_heap_destroy(h);
   return 0;
 }
 
+DEF_TEST(timeheap) {
+  enum { N = 1000 };
+  static int values[N];
+  c_timeheap_t *h;
+
+  CHECK_NOT_NULL(h = c_timeheap_create());
+  EXPECT_EQ_PTR(NULL, c_timeheap_peek_root(h, NULL));
+  EXPECT_EQ_PTR(NULL, c_timeheap_get_root(h, NULL));
+  EXPECT_EQ_PTR(NULL, c_timeheap_replace_root(h, 1, &values[0], NULL));
+  EXPECT_EQ_INT(0, (int)c_timeheap_size(h));
+
+  /* Keys 0 .. N/2-1, followed by keys that each occur four times, inserted in
+   * random order. */
+  for (int i = 0; i < N; i++)
+    values[i] = (i < N / 2) ? i : N / 2 + (i - N / 2) / 4;
+  srand(23);
+  for (int i = N - 1; i > 0; i--) {
+    int j = rand() % (i + 1);
+    int tmp = values[i];
+    values[i] = values[j];
+    values[j] = tmp;
+  }
+  for (int i = 0; i < N; i++)
+    CHECK_ZERO(c_timeheap_insert(h, (uint64_t)values[i], &values[i]));
+  EXPECT_EQ_INT(N, (int)c_timeheap_size(h));
+
+  /* Re-schedule the first half with keys beyond the existing ones. */
+  for (int i = 0; i < N / 2; i++) {
+    uint64_t key = 0;
+    int *ret;
+
+    CHECK_NOT_NULL(ret = c_timeheap_peek_root(h, &key));
+    EXPECT_EQ_UINT64((uint64_t)i, key);
+    CHECK_NOT_NULL(ret = c_timeheap_replace_root(h, (uint64_t)(N + i), ret,
+                                                 &key));
+    EXPECT_EQ_UINT64((uint64_t)i, key);
+  }
+  EXPECT_EQ_INT(N, (int)c_timeheap_size(h));
+
+  uint64_t last = 0;
+  int count = 0;
+  while (c_timeheap_size(h) > 0) {
+    uint64_t key = 0;
+    int *ret;
+
+    CHECK_NOT_NULL(ret = c_timeheap_get_root(h, &key));
+    if (key < last)
+      break;
+    last = key;
+    count++;
+  }
+  EXPECT_EQ_INT(N, count);
+  EXPECT_EQ_UINT64((uint64_t)(N + N / 2 - 1), last);
+
+  c_timeheap_destroy(h);
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(simple);
+  RUN_TEST(timeheap);
 
   END_TEST;
 }
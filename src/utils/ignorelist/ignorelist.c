@@ -59,33 +59,112 @@
 /*
  * private prototypes
  */
-struct ignorelist_item_s {
 #if HAVE_REGEX_H
+struct ignorelist_item_s {
   regex_t *rmatch; /* regular expression entry identification */
-#endif
-  char *smatch; /* string entry identification */
+  char *re_str;    /* source of `rmatch' */
   struct ignorelist_item_s *next;
 };
 typedef struct ignorelist_item_s ignorelist_item_t;
+#endif
+
+/* string entry identification, see ignorelist_lookup_string() */
+struct ignorelist_string_s {
+  char *smatch;
+  uint64_t hash;
+  unsigned int refs; /* number of times the entry has been added */
+};
+typedef struct ignorelist_string_s ignorelist_string_t;
 
 struct ignorelist_s {
-  int ignore;              /* ignore entries */
-  ignorelist_item_t *head; /* pointer to the first entry */
+  int ignore; /* ignore entries */
+#if HAVE_REGEX_H
+  ignorelist_item_t *head; /* pointer to the first regex entry */
+  /* All regular expressions combined into a single alternation, so that an
+   * entry is matched against all of them in one pass. NULL if the regular
+   * expressions cannot be combined. */
+  regex_t *rmatch_all;
+#endif
+  /* Open addressing hash set of the string entries. */
+  ignorelist_string_t *strings;
+  size_t strings_size; /* always zero or a power of two */
+  size_t strings_num;
 };
 
+#define IGNORELIST_STRINGS_SIZE_MIN 16
+
 /* *** *** *** ********************************************* *** *** *** */
 /* *** *** *** *** *** ***   private functions   *** *** *** *** *** *** */
 /* *** *** *** ********************************************* *** *** *** */
 
-static inline void ignorelist_append(ignorelist_t *il,
-                                     ignorelist_item_t *item) {
-  assert((il != NULL) && (item != NULL));
+#if HAVE_REGEX_H
+static void ignorelist_free_combined(ignorelist_t *il) {
+  if (il->rmatch_all == NULL)
+    return;
 
-  item->next = il->head;
-  il->head = item;
-}
+  regfree(il->rmatch_all);
+  sfree(il->rmatch_all);
+} /* void ignorelist_free_combined */
+
+/*
+ * (re-)compile the alternation of all regular expressions
+ */
+static void ignorelist_combine_regex(ignorelist_t *il) {
+  size_t len = 0;
+  char *re_str;
+  int status;
+
+  ignorelist_free_combined(il);
+
+  for (ignorelist_item_t *item = il->head; item != NULL; item = item->next) {
+    /* Back-references are numbered by the other subexpressions in the
+     * alternation, so they can't be combined. */
+    for (char const *c = item->re_str; *c != 0; c++) {
+      if ((c[0] == '\\') && isdigit((unsigned char)c[1]))
+        return;
+      if ((c[0] == '\\') && (c[1] != 0))
+        c++;
+    }
+    len += strlen(item->re_str) + strlen("|()");
+  }
+
+  /* A single regular expression is used as-is. */
+  if ((il->head == NULL) || (il->head->next == NULL))
+    return;
+
+  re_str = malloc(len + 1);
+  if (re_str == NULL) {
+    ERROR("ignorelist_combine_regex: malloc failed.");
+    return;
+  }
+
+  re_str[0] = 0;
+  for (ignorelist_item_t *item = il->head; item != NULL; item = item->next) {
+    if (item != il->head)
+      strcat(re_str, "|");
+    strcat(re_str, "(");
+    strcat(re_str, item->re_str);
+    strcat(re_str, ")");
+  }
+
+  il->rmatch_all = calloc(1, sizeof(*il->rmatch_all));
+  if (il->rmatch_all == NULL) {
+    ERROR("ignorelist_combine_regex: calloc failed.");
+    sfree(re_str);
+    return;
+  }
+
+  status = regcomp(il->rmatch_all, re_str, REG_EXTENDED | REG_NOSUB);
+  if (status != 0) {
+    DEBUG("ignorelist_combine_regex: Compiling \"%s\" failed with status %i. "
+          "Matching the regular expressions one by one.",
+          re_str, status);
+    sfree(il->rmatch_all);
+  }
+
+  sfree(re_str);
+} /* void ignorelist_combine_regex */
 
-#if HAVE_REGEX_H
 static int ignorelist_append_regex(ignorelist_t *il, const char *re_str) {
   regex_t *re;
   ignorelist_item_t *entry;
@@ -117,58 +196,124 @@ static int ignorelist_append_regex(ignorelist_t *il, const char *re_str) {
     return ENOMEM;
   }
   entry->rmatch = re;
+  entry->re_str = sstrdup(re_str);
+
+  entry->next = il->head;
+  il->head = entry;
 
-  ignorelist_append(il, entry);
+  ignorelist_combine_regex(il);
   return 0;
 } /* int ignorelist_append_regex */
-#endif
 
-static int ignorelist_append_string(ignorelist_t *il, const char *entry) {
-  ignorelist_item_t *new;
+/*
+ * check list for entry regex match
+ * return 1 if found
+ */
+static int ignorelist_match_regex(ignorelist_t *il, const char *entry) {
+  assert((il != NULL) && (entry != NULL) && (strlen(entry) > 0));
 
-  /* create new entry */
-  if ((new = calloc(1, sizeof(*new))) == NULL) {
-    ERROR("cannot allocate new entry");
-    return 1;
-  }
-  new->smatch = sstrdup(entry);
+  if (il->rmatch_all != NULL)
+    return regexec(il->rmatch_all, entry, 0, NULL, 0) == 0;
 
-  /* append new entry */
-  ignorelist_append(il, new);
+  for (ignorelist_item_t *item = il->head; item != NULL; item = item->next) {
+    if (regexec(item->rmatch, entry, 0, NULL, 0) == 0)
+      return 1;
+  }
 
   return 0;
-} /* int ignorelist_append_string(ignorelist_t *il, const char *entry) */
+} /* int ignorelist_match_regex (ignorelist_t *il, const char *entry) */
+#endif
 
-#if HAVE_REGEX_H
 /*
- * check list for entry regex match
- * return 1 if found
+ * return the slot of `entry' in the string set, or the empty slot it would
+ * be stored in
  */
-static int ignorelist_match_regex(ignorelist_item_t *item, const char *entry) {
-  assert((item != NULL) && (item->rmatch != NULL) && (entry != NULL) &&
-         (strlen(entry) > 0));
+static ignorelist_string_t *ignorelist_lookup_string(ignorelist_t *il,
+                                                     const char *entry,
+                                                     uint64_t hash) {
+  size_t mask = il->strings_size - 1;
+
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    ignorelist_string_t *s = il->strings + i;
+    if (s->smatch == NULL)
+      return s;
+    if ((s->hash == hash) && (strcmp(entry, s->smatch) == 0))
+      return s;
+  }
+} /* ignorelist_string_t *ignorelist_lookup_string */
+
+static int ignorelist_resize_strings(ignorelist_t *il, size_t size) {
+  ignorelist_string_t *old = il->strings;
+  size_t old_size = il->strings_size;
 
-  /* match regex */
-  if (regexec(item->rmatch, entry, 0, NULL, 0) == 0)
+  il->strings = calloc(size, sizeof(*il->strings));
+  if (il->strings == NULL) {
+    il->strings = old;
+    return ENOMEM;
+  }
+  il->strings_size = size;
+
+  for (size_t i = 0; i < old_size; i++) {
+    if (old[i].smatch == NULL)
+      continue;
+    *ignorelist_lookup_string(il, old[i].smatch, old[i].hash) = old[i];
+  }
+
+  sfree(old);
+  return 0;
+} /* int ignorelist_resize_strings */
+
+static int ignorelist_append_string(ignorelist_t *il, const char *entry) {
+  ignorelist_string_t *s;
+  uint64_t hash = hash_name(entry);
+
+  /* keep the load factor below one half */
+  if ((2 * (il->strings_num + 1) > il->strings_size) &&
+      (ignorelist_resize_strings(il, (il->strings_size > 0)
+                                         ? 2 * il->strings_size
+                                         : IGNORELIST_STRINGS_SIZE_MIN) != 0)) {
+    ERROR("cannot allocate new entry");
+    return 1;
+  }
+
+  s = ignorelist_lookup_string(il, entry, hash);
+  if (s->smatch != NULL) {
+    s->refs++;
+    return 0;
+  }
+
+  s->smatch = strdup(entry);
+  if (s->smatch == NULL) {
+    ERROR("cannot allocate new entry");
     return 1;
+  }
+  s->hash = hash;
+  s->refs = 1;
+  il->strings_num++;
 
   return 0;
-} /* int ignorelist_match_regex (ignorelist_item_t *item, const char *entry) */
-#endif
+} /* int ignorelist_append_string(ignorelist_t *il, const char *entry) */
 
 /*
  * check list for entry string match
  * return 1 if found
  */
-static int ignorelist_match_string(ignorelist_item_t *item, const char *entry) {
-  assert((item != NULL) && (item->smatch != NULL) && (entry != NULL) &&
-         (strlen(entry) > 0));
+static int ignorelist_match_string(ignorelist_t *il, const char *entry) {
+  assert((il != NULL) && (entry != NULL) && (strlen(entry) > 0));
 
-  if (strcmp(entry, item->smatch) == 0)
-    return 1;
+  if (il->strings_num == 0)
+    return 0;
 
-  return 0;
-} /* int ignorelist_match_string (ignorelist_item_t *item, const char *entry) */
+  return ignorelist_lookup_string(il, entry, hash_name(entry))->smatch != NULL;
+} /* int ignorelist_match_string (ignorelist_t *il, const char *entry) */
+
+static bool ignorelist_is_empty(ignorelist_t *il) {
+#if HAVE_REGEX_H
+  if (il->head != NULL)
+    return false;
+#endif
+  return il->strings_num == 0;
+} /* bool ignorelist_is_empty */
 
 /* *** *** *** ******************************************** *** *** *** */
 /* *** *** *** *** *** ***   public functions   *** *** *** *** *** *** */
@@ -198,27 +343,26 @@ ignorelist_t *ignorelist_create(int invert) {
  * free memory used by ignorelist_t
  */
 void ignorelist_free(ignorelist_t *il) {
-  ignorelist_item_t *this;
-  ignorelist_item_t *next;
-
   if (il == NULL)
     return;
 
+#if HAVE_REGEX_H
+  ignorelist_item_t *this;
+  ignorelist_item_t *next;
+
   for (this = il->head; this != NULL; this = next) {
     next = this->next;
-#if HAVE_REGEX_H
-    if (this->rmatch != NULL) {
-      regfree(this->rmatch);
-      sfree(this->rmatch);
-      this->rmatch = NULL;
-    }
-#endif
-    if (this->smatch != NULL) {
-      sfree(this->smatch);
-      this->smatch = NULL;
-    }
+    regfree(this->rmatch);
+    sfree(this->rmatch);
+    sfree(this->re_str);
     sfree(this);
   }
+  ignorelist_free_combined(il);
+#endif
+
+  for (size_t i = 0; i < il->strings_size; i++)
+    sfree(il->strings[i].smatch);
+  sfree(il->strings);
 
   sfree(il);
 } /* void ignorelist_destroy (ignorelist_t *il) */
@@ -283,30 +427,44 @@ int ignorelist_add(ignorelist_t *il, const char *entry) {
  * return 0 for success
  */
 int ignorelist_remove(ignorelist_t *il, const char *entry) {
+  ignorelist_string_t *s;
+  size_t mask;
+
   /* if no entries, nothing to remove */
-  if ((il == NULL) || (il->head == NULL))
+  if ((il == NULL) || (il->strings_num == 0))
     return 1;
 
   if ((entry == NULL) || (strlen(entry) == 0))
     return 1;
 
-  /* traverse list and check entries */
-  for (ignorelist_item_t *prev = NULL, *traverse = il->head; traverse != NULL;
-       prev = traverse, traverse = traverse->next) {
-    if (traverse->smatch != NULL && strcmp(traverse->smatch, entry) == 0) {
-      if (prev == NULL) {
-        il->head = traverse->next;
-      } else {
-        prev->next = traverse->next;
-      }
-      sfree(traverse->smatch);
-      traverse->smatch = NULL;
-      sfree(traverse);
-      return 0;
-    }
-  } /* for traverse */
+  s = ignorelist_lookup_string(il, entry, hash_name(entry));
+  if (s->smatch == NULL)
+    return 1;
+
+  s->refs--;
+  if (s->refs > 0)
+    return 0;
+
+  sfree(s->smatch);
+  il->strings_num--;
+
+  /* Move following entries of the probe sequence into the hole, so that
+   * lookups don't stop early. */
+  mask = il->strings_size - 1;
+  for (size_t hole = (size_t)(s - il->strings), i = (hole + 1) & mask;
+       il->strings[i].smatch != NULL; i = (i + 1) & mask) {
+    size_t home = il->strings[i].hash & mask;
 
-  return 1;
+    /* Leave the entry where it is if `home' is cyclically in (hole, i]. */
+    if (((i - home) & mask) < ((i - hole) & mask))
+      continue;
+
+    il->strings[hole] = il->strings[i];
+    memset(il->strings + i, 0, sizeof(il->strings[i]));
+    hole = i;
+  }
+
+  return 0;
 } /* int ignorelist_remove (ignorelist_t *il, const char *entry) */
 
 /*
@@ -315,26 +473,19 @@ int ignorelist_remove(ignorelist_t *il, const char *entry) {
  */
 int ignorelist_match(ignorelist_t *il, const char *entry) {
   /* if no entries, collect all */
-  if ((il == NULL) || (il->head == NULL))
+  if ((il == NULL) || ignorelist_is_empty(il))
     return 0;
 
   if ((entry == NULL) || (strlen(entry) == 0))
     return 0;
 
-  /* traverse list and check entries */
-  for (ignorelist_item_t *traverse = il->head; traverse != NULL;
-       traverse = traverse->next) {
+  if (ignorelist_match_string(il, entry))
+    return il->ignore;
+
 #if HAVE_REGEX_H
-    if (traverse->rmatch != NULL) {
-      if (ignorelist_match_regex(traverse, entry))
-        return il->ignore;
-    } else
+  if (ignorelist_match_regex(il, entry))
+    return il->ignore;
 #endif
-    {
-      if (ignorelist_match_string(traverse, entry))
-        return il->ignore;
-    }
-  } /* for traverse */
 
   return 1 - il->ignore;
 } /* int ignorelist_match (ignorelist_t *il, const char *entry) */
@@ -0,0 +1,121 @@
+/**
+ * collectd - src/utils/ignorelist/ignorelist_test.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "utils/common/common.h" /* for STATIC_ARRAY_SIZE */
+
+#include "testing.h"
+#include "utils/ignorelist/ignorelist.h"
+
+DEF_TEST(strings) {
+  ignorelist_t *il;
+  char name[32];
+
+  CHECK_NOT_NULL(il = ignorelist_create(/* invert = */ 0));
+
+  /* no entries: collect all */
+  EXPECT_EQ_INT(0, ignorelist_match(il, "eth0"));
+
+  /* enough entries to grow the set a few times */
+  for (int i = 0; i < 100; i++) {
+    snprintf(name, sizeof(name), "eth%d", i);
+    CHECK_ZERO(ignorelist_add(il, name));
+  }
+  CHECK_ZERO(ignorelist_add(il, "eth7"));
+
+  for (int i = 0; i < 100; i++) {
+    snprintf(name, sizeof(name), "eth%d", i);
+    EXPECT_EQ_INT(1, ignorelist_match(il, name));
+  }
+  EXPECT_EQ_INT(0, ignorelist_match(il, "eth100"));
+  EXPECT_EQ_INT(0, ignorelist_match(il, "eth"));
+
+  /* removing entries keeps the others reachable */
+  for (int i = 0; i < 100; i += 3) {
+    snprintf(name, sizeof(name), "eth%d", i);
+    CHECK_ZERO(ignorelist_remove(il, name));
+  }
+  for (int i = 0; i < 100; i++) {
+    snprintf(name, sizeof(name), "eth%d", i);
+    EXPECT_EQ_INT((i % 3) ? 1 : 0, ignorelist_match(il, name));
+  }
+  OK(ignorelist_remove(il, "eth0") != 0);
+
+  /* "eth7" has been added twice */
+  CHECK_ZERO(ignorelist_remove(il, "eth7"));
+  EXPECT_EQ_INT(1, ignorelist_match(il, "eth7"));
+  CHECK_ZERO(ignorelist_remove(il, "eth7"));
+  EXPECT_EQ_INT(0, ignorelist_match(il, "eth7"));
+
+  /* inverted: only collect the entries */
+  ignorelist_set_invert(il, 1);
+  EXPECT_EQ_INT(0, ignorelist_match(il, "eth1"));
+  EXPECT_EQ_INT(1, ignorelist_match(il, "lo"));
+
+  ignorelist_free(il);
+  return 0;
+}
+
+DEF_TEST(regex) {
+  struct {
+    char const *entry;
+    int want;
+  } cases[] = {
+      {"eth0", 1},    {"veth1234", 1},  {"lo", 1},    {"loop", 0},
+      {"docker0", 1}, {"wlan0", 0},     {"bond0", 0}, {"bond0.100", 1},
+  };
+
+  ignorelist_t *il;
+
+  CHECK_NOT_NULL(il = ignorelist_create(/* invert = */ 0));
+  CHECK_ZERO(ignorelist_add(il, "/^eth[0-9]+$/"));
+  CHECK_ZERO(ignorelist_add(il, "/^veth/"));
+  CHECK_ZERO(ignorelist_add(il, "lo"));
+  CHECK_ZERO(ignorelist_add(il, "/docker|bond.*\\./"));
+  OK(ignorelist_add(il, "/[/") != 0);
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    printf("## Case %" PRIsz ": %s\n", i, cases[i].entry);
+    EXPECT_EQ_INT(cases[i].want, ignorelist_match(il, cases[i].entry));
+  }
+
+  /* Back-references can't be combined with the other expressions. */
+  CHECK_ZERO(ignorelist_add(il, "/^(a)\\1$/"));
+  EXPECT_EQ_INT(1, ignorelist_match(il, "aa"));
+  EXPECT_EQ_INT(0, ignorelist_match(il, "ab"));
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    printf("## Case %" PRIsz ": %s\n", i, cases[i].entry);
+    EXPECT_EQ_INT(cases[i].want, ignorelist_match(il, cases[i].entry));
+  }
+
+  ignorelist_free(il);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(strings);
+  RUN_TEST(regex);
+
+  END_TEST;
+}
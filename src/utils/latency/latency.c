@@ -24,6 +24,7 @@
  *   Florian Forster <ff at octo.it>
  **/
 
+
 #include "collectd.h"
 
 #include "plugin.h"
@@ -37,10 +38,23 @@
 #define LLONG_MAX 9223372036854775807LL
 #endif
 
-#ifndef HISTOGRAM_DEFAULT_BIN_WIDTH
-/* 1048576 = 2^20 ^= 1/1024 s */
-#define HISTOGRAM_DEFAULT_BIN_WIDTH 1048576
-#endif
+/*
+ * The histogram is log-linear, similar to HdrHistogram: every power of two is
+ * divided into 2^LATENCY_SUB_BITS bins of equal width, so that the width of a
+ * bin is at most 1/128 of the latencies it holds. Below 2^(LATENCY_SUB_BITS+1)
+ * units the bins are one unit wide. A unit is 2^-20 seconds, about one
+ * microsecond, and the bins cover 2^LATENCY_RANGE_BITS units, about 68
+ * minutes. Longer latencies are counted in the last bin.
+ *
+ * Like the linear histogram this replaces, each bin has an exclusive lower and
+ * an inclusive upper bound, so that a latency of exactly 1.0 s is counted in
+ * the bin ending at 1.0 s.
+ */
+#define LATENCY_UNIT_BITS 10
+#define LATENCY_SUB_BITS 7
+#define LATENCY_RANGE_BITS 32
+#define LATENCY_NUM_BINS                                                       \
+  (((LATENCY_RANGE_BITS - LATENCY_SUB_BITS) + 1) << LATENCY_SUB_BITS)
 
 struct latency_counter_s {
   cdtime_t start_time;
@@ -51,67 +65,50 @@ struct latency_counter_s {
   cdtime_t min;
   cdtime_t max;
 
-  cdtime_t bin_width;
-  int histogram[HISTOGRAM_NUM_BINS];
+  uint32_t histogram[LATENCY_NUM_BINS];
 };
 
-/*
- * Histogram represents the distribution of data, it has a list of "bins".
- * Each bin represents an interval and has a count (frequency) of
- * number of values fall within its interval.
- *
- * Histogram's range is determined by the number of bins and the bin width,
- * There are 1000 bins and all bins have the same width of default 1
- * millisecond. When a value above this range is added, Histogram's range is
- * increased by increasing the bin width (note that number of bins remains
- * always at 1000). This operation of increasing bin width is little expensive
- * as each bin need to be visited to update its count. To reduce frequent change
- * of bin width, new bin width will be the next nearest power of 2. Example: 2,
- * 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 5086, ...
- *
- * So, if the required bin width is 300, then new bin width will be 512 as it is
- * the next nearest power of 2.
- */
-static void change_bin_width(latency_counter_t *lc, cdtime_t latency) /* {{{ */
+static int msb64(uint64_t x) /* {{{ */
 {
-  /* This function is called because the new value is above histogram's range.
-   * First find the required bin width:
-   *           requiredBinWidth = (value + 1) / numBins
-   * then get the next nearest power of 2
-   *           newBinWidth = 2^(ceil(log2(requiredBinWidth)))
-   */
-  double required_bin_width =
-      ((double)(latency + 1)) / ((double)HISTOGRAM_NUM_BINS);
-  double required_bin_width_logbase2 = log(required_bin_width) / log(2.0);
-  cdtime_t new_bin_width =
-      (cdtime_t)(pow(2.0, ceil(required_bin_width_logbase2)) + .5);
-  cdtime_t old_bin_width = lc->bin_width;
-
-  lc->bin_width = new_bin_width;
-
-  /* bin_width has been increased, now iterate through all bins and move the
-   * old bin's count to new bin. */
-  if (lc->num > 0) // if the histogram has data then iterate else skip
-  {
-    double width_change_ratio =
-        ((double)old_bin_width) / ((double)new_bin_width);
-
-    for (size_t i = 0; i < HISTOGRAM_NUM_BINS; i++) {
-      size_t new_bin = (size_t)(((double)i) * width_change_ratio);
-      if (i == new_bin)
-        continue;
-      assert(new_bin < i);
-
-      lc->histogram[new_bin] += lc->histogram[i];
-      lc->histogram[i] = 0;
-    }
+#if defined(__GNUC__)
+  return 63 - __builtin_clzll(x);
+#else
+  int n = 0;
+  while (x >>= 1)
+    n++;
+  return n;
+#endif
+} /* }}} int msb64 */
+
+/* Returns the bin `latency', which must not be zero, is counted in. */
+static size_t latency_bin(cdtime_t latency) /* {{{ */
+{
+  uint64_t x = (latency - 1) >> LATENCY_UNIT_BITS;
+
+  if ((x >> LATENCY_RANGE_BITS) != 0)
+    return LATENCY_NUM_BINS - 1;
+  if (x < (2 << LATENCY_SUB_BITS))
+    return (size_t)x;
+
+  int shift = msb64(x) - LATENCY_SUB_BITS;
+  return ((size_t)shift << LATENCY_SUB_BITS) + (size_t)(x >> shift);
+} /* }}} size_t latency_bin */
+
+/* Returns the (exclusive) lower bound of `bin' and stores its width in
+ * `ret_width'. */
+static cdtime_t latency_bin_lower(size_t bin, cdtime_t *ret_width) /* {{{ */
+{
+  int shift = 0;
+  uint64_t x = (uint64_t)bin;
+
+  if (bin >= (2 << LATENCY_SUB_BITS)) {
+    shift = (int)(bin >> LATENCY_SUB_BITS) - 1;
+    x = ((uint64_t)bin - ((uint64_t)shift << LATENCY_SUB_BITS)) << shift;
   }
 
-  DEBUG("utils_latency: change_bin_width: latency = %.3f; "
-        "old_bin_width = %.3f; new_bin_width = %.3f;",
-        CDTIME_T_TO_DOUBLE(latency), CDTIME_T_TO_DOUBLE(old_bin_width),
-        CDTIME_T_TO_DOUBLE(new_bin_width));
-} /* }}} void change_bin_width */
+  *ret_width = ((cdtime_t)1 << shift) << LATENCY_UNIT_BITS;
+  return (cdtime_t)x << LATENCY_UNIT_BITS;
+} /* }}} cdtime_t latency_bin_lower */
 
 latency_counter_t *latency_counter_create(void) /* {{{ */
 {
@@ -121,7 +118,6 @@ latency_counter_t *latency_counter_create(void) /* {{{ */
   if (lc == NULL)
     return NULL;
 
-  lc->bin_width = HISTOGRAM_DEFAULT_BIN_WIDTH;
   latency_counter_reset(lc);
   return lc;
 } /* }}} latency_counter_t *latency_counter_create */
@@ -133,8 +129,6 @@ void latency_counter_destroy(latency_counter_t *lc) /* {{{ */
 
 void latency_counter_add(latency_counter_t *lc, cdtime_t latency) /* {{{ */
 {
-  cdtime_t bin;
-
   if ((lc == NULL) || (latency == 0) || (latency > ((cdtime_t)LLONG_MAX)))
     return;
 
@@ -148,50 +142,43 @@ void latency_counter_add(latency_counter_t *lc, cdtime_t latency) /* {{{ */
   if (lc->max < latency)
     lc->max = latency;
 
-  /* A latency of _exactly_ 1.0 ms is stored in the buffer 0, so
-   * subtract one from the cdtime_t value so that exactly 1.0 ms get sorted
-   * accordingly. */
-  bin = (latency - 1) / lc->bin_width;
-  if (bin >= HISTOGRAM_NUM_BINS) {
-    change_bin_width(lc, latency);
-    bin = (latency - 1) / lc->bin_width;
-    if (bin >= HISTOGRAM_NUM_BINS) {
-      P_ERROR("latency_counter_add: Invalid bin: %" PRIu64, bin);
-      return;
-    }
-  }
-  lc->histogram[bin]++;
+  lc->histogram[latency_bin(latency)]++;
 } /* }}} void latency_counter_add */
 
+void latency_counter_merge(latency_counter_t *dst, /* {{{ */
+                           const latency_counter_t *src) {
+  if ((dst == NULL) || (src == NULL) || (src->num == 0))
+    return;
+
+  /* All counters use the same bins. */
+  for (size_t i = latency_bin(src->min); i <= latency_bin(src->max); i++)
+    dst->histogram[i] += src->histogram[i];
+
+  if ((dst->num == 0) || (dst->min > src->min))
+    dst->min = src->min;
+  if (dst->max < src->max)
+    dst->max = src->max;
+  dst->sum += src->sum;
+  dst->num += src->num;
+} /* }}} void latency_counter_merge */
+
 void latency_counter_reset(latency_counter_t *lc) /* {{{ */
 {
   if (lc == NULL)
     return;
 
-  cdtime_t bin_width = lc->bin_width;
-  cdtime_t max_bin = (lc->max - 1) / lc->bin_width;
-
-/*
-  If max latency is REDUCE_THRESHOLD times less than histogram's range,
-  then cut it in half. REDUCE_THRESHOLD must be >= 2.
-  Value of 4 is selected to reduce frequent changes of bin width.
-*/
-#define REDUCE_THRESHOLD 4
-  if ((lc->num > 0) && (lc->bin_width >= HISTOGRAM_DEFAULT_BIN_WIDTH * 2) &&
-      (max_bin < HISTOGRAM_NUM_BINS / REDUCE_THRESHOLD)) {
-    /* new bin width will be the previous power of 2 */
-    bin_width = bin_width / 2;
-
-    DEBUG("utils_latency: latency_counter_reset: max_latency = %.3f; "
-          "max_bin = %" PRIu64 "; old_bin_width = %.3f; new_bin_width = %.3f;",
-          CDTIME_T_TO_DOUBLE(lc->max), max_bin,
-          CDTIME_T_TO_DOUBLE(lc->bin_width), CDTIME_T_TO_DOUBLE(bin_width));
+  /* Only the bins between min and max can be in use. */
+  if (lc->num > 0) {
+    size_t first = latency_bin(lc->min);
+    size_t last = latency_bin(lc->max);
+    memset(lc->histogram + first, 0,
+           (last - first + 1) * sizeof(lc->histogram[0]));
   }
 
-  memset(lc, 0, sizeof(*lc));
-
-  /* preserve bin width */
-  lc->bin_width = bin_width;
+  lc->sum = 0;
+  lc->num = 0;
+  lc->min = 0;
+  lc->max = 0;
   lc->start_time = cdtime();
 } /* }}} void latency_counter_reset */
 
@@ -240,43 +227,48 @@ cdtime_t latency_counter_get_percentile(latency_counter_t *lc, /* {{{ */
   double percent_lower;
   double p;
   cdtime_t latency_lower;
+  cdtime_t bin_width;
   cdtime_t latency_interpolated;
-  int sum;
+  uint64_t sum;
   size_t i;
 
   if ((lc == NULL) || (lc->num == 0) || !((percent > 0.0) && (percent < 100.0)))
     return 0;
 
-  /* Find index i so that at least "percent" events are within i+1 ms. */
+  /* Find bin i so that at least "percent" events are within its upper
+   * bound. */
   percent_upper = 0.0;
   percent_lower = 0.0;
   sum = 0;
-  for (i = 0; i < HISTOGRAM_NUM_BINS; i++) {
+  for (i = latency_bin(lc->min); i < LATENCY_NUM_BINS; i++) {
+    if (lc->histogram[i] == 0)
+      continue;
+
     percent_lower = percent_upper;
     sum += lc->histogram[i];
-    if (sum == 0)
-      percent_upper = 0.0;
-    else
-      percent_upper = 100.0 * ((double)sum) / ((double)lc->num);
+    percent_upper = 100.0 * ((double)sum) / ((double)lc->num);
 
     if (percent_upper >= percent)
       break;
   }
 
-  if (i >= HISTOGRAM_NUM_BINS)
+  if (i >= LATENCY_NUM_BINS)
     return 0;
 
   assert(percent_upper >= percent);
   assert(percent_lower < percent);
 
-  if (i == 0)
-    return lc->bin_width;
-
-  latency_lower = ((cdtime_t)i) * lc->bin_width;
+  latency_lower = latency_bin_lower(i, &bin_width);
   p = (percent - percent_lower) / (percent_upper - percent_lower);
 
   latency_interpolated =
-      latency_lower + DOUBLE_TO_CDTIME_T(p * CDTIME_T_TO_DOUBLE(lc->bin_width));
+      latency_lower + DOUBLE_TO_CDTIME_T(p * CDTIME_T_TO_DOUBLE(bin_width));
+
+  /* The first and the last bin may be only partially used. */
+  if (latency_interpolated < lc->min)
+    latency_interpolated = lc->min;
+  if (latency_interpolated > lc->max)
+    latency_interpolated = lc->max;
 
   DEBUG("latency_counter_get_percentile: latency_interpolated = %.3f",
         CDTIME_T_TO_DOUBLE(latency_interpolated));
@@ -294,49 +286,49 @@ double latency_counter_get_rate(const latency_counter_t *lc, /* {{{ */
   if (lower == upper)
     return 0;
 
-  /* Buckets have an exclusive lower bound and an inclusive upper bound. That
-   * means that the first bucket, index 0, represents (0-bin_width]. That means
-   * that latency==bin_width needs to result in bin=0, that's why we need to
-   * subtract one before dividing by bin_width. */
-  cdtime_t lower_bin = 0;
-  if (lower)
-    /* lower is *exclusive* => determine bucket for lower+1 */
-    lower_bin = ((lower + 1) - 1) / lc->bin_width;
+  cdtime_t last_width;
+  cdtime_t range =
+      latency_bin_lower(LATENCY_NUM_BINS - 1, &last_width) + last_width;
 
-  /* lower is greater than the longest latency observed => rate is zero. */
-  if (lower_bin >= HISTOGRAM_NUM_BINS)
+  /* lower is greater than the histogram's range => rate is zero. */
+  if (lower >= range)
     return 0;
 
-  cdtime_t upper_bin = HISTOGRAM_NUM_BINS - 1;
-  if (upper)
-    upper_bin = (upper - 1) / lc->bin_width;
+  /* Bins have an exclusive lower bound and an inclusive upper bound. */
+  size_t lower_bin = 0;
+  if (lower)
+    /* lower is *exclusive* => determine bin for lower+1 */
+    lower_bin = latency_bin(lower + 1);
 
-  if (upper_bin >= HISTOGRAM_NUM_BINS) {
-    upper_bin = HISTOGRAM_NUM_BINS - 1;
+  size_t upper_bin = LATENCY_NUM_BINS - 1;
+  if (upper && (upper < range))
+    upper_bin = latency_bin(upper);
+  else
     upper = 0;
-  }
 
   double sum = 0;
   for (size_t i = lower_bin; i <= upper_bin; i++)
     sum += lc->histogram[i];
 
+  cdtime_t bin_width;
   if (lower) {
     /* Approximate ratio of requests in lower_bin, that fall between
      * lower_bin_boundary and lower. This ratio is then subtracted from sum to
      * increase accuracy. */
-    cdtime_t lower_bin_boundary = lower_bin * lc->bin_width;
+    cdtime_t lower_bin_boundary = latency_bin_lower(lower_bin, &bin_width);
     assert(lower >= lower_bin_boundary);
     double lower_ratio =
-        (double)(lower - lower_bin_boundary) / ((double)lc->bin_width);
+        (double)(lower - lower_bin_boundary) / ((double)bin_width);
     sum -= lower_ratio * lc->histogram[lower_bin];
   }
 
   if (upper) {
     /* As above: approximate ratio of requests in upper_bin, that fall between
      * upper and upper_bin_boundary. */
-    cdtime_t upper_bin_boundary = (upper_bin + 1) * lc->bin_width;
+    cdtime_t upper_bin_boundary =
+        latency_bin_lower(upper_bin, &bin_width) + bin_width;
     assert(upper <= upper_bin_boundary);
-    double ratio = (double)(upper_bin_boundary - upper) / (double)lc->bin_width;
+    double ratio = (double)(upper_bin_boundary - upper) / (double)bin_width;
     sum -= ratio * lc->histogram[upper_bin];
   }
 
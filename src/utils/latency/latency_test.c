@@ -102,15 +102,10 @@ DEF_TEST(percentile) {
 }
 
 DEF_TEST(get_rate) {
-  /* We re-declare the struct here so we can inspect its content. */
+  /* We re-declare the first member of the struct here so we can get the start
+   * time. */
   struct {
     cdtime_t start_time;
-    cdtime_t sum;
-    size_t num;
-    cdtime_t min;
-    cdtime_t max;
-    cdtime_t bin_width;
-    int histogram[HISTOGRAM_NUM_BINS];
   } * peek;
   latency_counter_t *l;
 
@@ -121,77 +116,53 @@ DEF_TEST(get_rate) {
     latency_counter_add(l, TIME_T_TO_CDTIME_T(i));
   }
 
-  /* We expect a bucket width of 125ms. */
-  EXPECT_EQ_UINT64(DOUBLE_TO_CDTIME_T(0.125), peek->bin_width);
-
-  struct {
-    size_t index;
-    int want;
-  } bucket_cases[] = {
-      {0, 0},  /* (0.000-0.125] */
-      {1, 0},  /* (0.125-0.250] */
-      {2, 0},  /* (0.250-0.375] */
-      {3, 0},  /* (0.375-0.500] */
-      {4, 0},  /* (0.500-0.625] */
-      {5, 0},  /* (0.625-0.750] */
-      {6, 0},  /* (0.750-0.875] */
-      {7, 1},  /* (0.875-1.000] */
-      {8, 0},  /* (1.000-1.125] */
-      {9, 0},  /* (1.125-1.250] */
-      {10, 0}, /* (1.250-1.375] */
-      {11, 0}, /* (1.375-1.500] */
-      {12, 0}, /* (1.500-1.625] */
-      {13, 0}, /* (1.625-1.750] */
-      {14, 0}, /* (1.750-1.875] */
-      {15, 1}, /* (1.875-2.000] */
-      {16, 0}, /* (2.000-2.125] */
-  };
-
-  for (size_t i = 0; i < STATIC_ARRAY_SIZE(bucket_cases); i++) {
-    size_t index = bucket_cases[i].index;
-    EXPECT_EQ_INT(bucket_cases[i].want, peek->histogram[index]);
-  }
-
+  /* Around 1s the bins are 1/256s wide, around 2s they are 1/128s wide. */
   struct {
     cdtime_t lower_bound;
     cdtime_t upper_bound;
     double want;
   } cases[] = {
       {
-          // bucket 6 is zero
+          // no updates in this range
           DOUBLE_TO_CDTIME_T_STATIC(0.750),
           DOUBLE_TO_CDTIME_T_STATIC(0.875),
           0.00,
       },
       {
-          // bucket 7 contains the t=1 update
+          // contains the t=1 update
           DOUBLE_TO_CDTIME_T_STATIC(0.875),
           DOUBLE_TO_CDTIME_T_STATIC(1.000),
           1.00,
       },
       {
-          // range: bucket 7 - bucket 15; contains the t=1 and t=2 updates
+          // the bin ending at 1.0 contains the t=1 update
+          DOUBLE_TO_CDTIME_T_STATIC(1.000 - (1.0 / 256.0)),
+          DOUBLE_TO_CDTIME_T_STATIC(1.000),
+          1.00,
+      },
+      {
+          // contains the t=1 and t=2 updates
           DOUBLE_TO_CDTIME_T_STATIC(0.875),
           DOUBLE_TO_CDTIME_T_STATIC(2.000),
           2.00,
       },
       {
-          // lower bucket is only partially applied
-          DOUBLE_TO_CDTIME_T_STATIC(0.875 + (0.125 / 4)),
+          // lower bin is only partially applied
+          DOUBLE_TO_CDTIME_T_STATIC(1.000 - (1.0 / 1024.0)),
           DOUBLE_TO_CDTIME_T_STATIC(2.000),
-          1.75,
+          1.25,
       },
       {
-          // upper bucket is only partially applied
+          // upper bin is only partially applied
           DOUBLE_TO_CDTIME_T_STATIC(0.875),
-          DOUBLE_TO_CDTIME_T_STATIC(2.000 - (0.125 / 4)),
-          1.75,
+          DOUBLE_TO_CDTIME_T_STATIC(2.000 - (1.0 / 256.0)),
+          1.50,
       },
       {
-          // both buckets are only partially applied
-          DOUBLE_TO_CDTIME_T_STATIC(0.875 + (0.125 / 4)),
-          DOUBLE_TO_CDTIME_T_STATIC(2.000 - (0.125 / 4)),
-          1.50,
+          // both bins are only partially applied
+          DOUBLE_TO_CDTIME_T_STATIC(1.000 - (1.0 / 1024.0)),
+          DOUBLE_TO_CDTIME_T_STATIC(2.000 - (1.0 / 256.0)),
+          0.75,
       },
       {
           // lower bound is unspecified
@@ -200,8 +171,8 @@ DEF_TEST(get_rate) {
           2.00,
       },
       {
-          // upper bound is unspecified
-          DOUBLE_TO_CDTIME_T_STATIC(125.000 - 0.125),
+          // upper bound is unspecified; the bin ending at 125s is 0.5s wide
+          DOUBLE_TO_CDTIME_T_STATIC(125.000 - 0.5),
           0,
           1.00,
       },
@@ -242,10 +213,75 @@ DEF_TEST(get_rate) {
   return 0;
 }
 
+DEF_TEST(relative_error) {
+  latency_counter_t *l;
+
+  CHECK_NOT_NULL(l = latency_counter_create());
+
+  /* From 10 microseconds to 30 minutes. */
+  for (double base = 1e-5; base < 3600.0; base *= 6.0) {
+    latency_counter_reset(l);
+    for (int i = 0; i < 1000; i++)
+      latency_counter_add(l, DOUBLE_TO_CDTIME_T(base * (1.0 + i / 1000.0)));
+
+    double want = base * 1.5;
+    double got = CDTIME_T_TO_DOUBLE(latency_counter_get_percentile(l, 50.0));
+    printf("# base = %g, want = %g, got = %g\n", base, want, got);
+    OK(fabs(got - want) <= want / 100.0);
+  }
+
+  latency_counter_destroy(l);
+  return 0;
+}
+
+DEF_TEST(merge) {
+  latency_counter_t *a, *b, *all;
+
+  CHECK_NOT_NULL(a = latency_counter_create());
+  CHECK_NOT_NULL(b = latency_counter_create());
+  CHECK_NOT_NULL(all = latency_counter_create());
+
+  /* `b' needs much wider bins than `a'. */
+  for (size_t i = 0; i < 100; i++) {
+    cdtime_t small = MS_TO_CDTIME_T(i + 1);
+    cdtime_t large = TIME_T_TO_CDTIME_T(((time_t)i) + 1);
+
+    latency_counter_add(a, small);
+    latency_counter_add(b, large);
+    latency_counter_add(all, small);
+    latency_counter_add(all, large);
+  }
+
+  latency_counter_merge(a, b);
+
+  EXPECT_EQ_INT(200, (int)latency_counter_get_num(a));
+  EXPECT_EQ_UINT64(latency_counter_get_min(all), latency_counter_get_min(a));
+  EXPECT_EQ_UINT64(latency_counter_get_max(all), latency_counter_get_max(a));
+  EXPECT_EQ_UINT64(latency_counter_get_sum(all), latency_counter_get_sum(a));
+  double percent[] = {10.0, 50.0, 75.0, 99.0};
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(percent); i++)
+    EXPECT_EQ_UINT64(latency_counter_get_percentile(all, percent[i]),
+                     latency_counter_get_percentile(a, percent[i]));
+
+  /* Merging into an empty counter copies the other one. */
+  latency_counter_reset(b);
+  latency_counter_merge(b, all);
+  EXPECT_EQ_UINT64(latency_counter_get_min(all), latency_counter_get_min(b));
+  EXPECT_EQ_UINT64(latency_counter_get_percentile(all, 50.0),
+                   latency_counter_get_percentile(b, 50.0));
+
+  latency_counter_destroy(a);
+  latency_counter_destroy(b);
+  latency_counter_destroy(all);
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(simple);
   RUN_TEST(percentile);
   RUN_TEST(get_rate);
+  RUN_TEST(relative_error);
+  RUN_TEST(merge);
 
   END_TEST;
 }
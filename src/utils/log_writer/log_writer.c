@@ -0,0 +1,238 @@
+/**
+ * collectd - src/utils/log_writer/log_writer.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+/* _GNU_SOURCE is needed in Linux to use pthread_setname_np */
+#define _GNU_SOURCE
+
+#include "collectd.h"
+
+#include "utils/common/common.h"
+#include "utils/log_writer/log_writer.h"
+#include "utils/ring/ring.h"
+
+#include <sys/uio.h>
+
+/* Maximum number of lines written with one writev(2) call. */
+#define LOG_WRITER_BATCH 64
+
+typedef struct {
+  char *line;
+  size_t len;
+} log_line_t;
+
+struct c_log_writer_s {
+  char *name;
+  char *file; /* NULL for stdout and stderr */
+  int fd;     /* set for stdout and stderr */
+
+  c_ring_t *ring;
+  pthread_t thread;
+  bool thread_started;
+
+  uint64_t dropped;
+  uint64_t dropped_reported; /* only accessed by the thread */
+};
+
+static int log_writer_open(c_log_writer_t *w) {
+  if (w->file == NULL)
+    return w->fd;
+
+  int fd = open(w->file, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+  if (fd < 0)
+    fprintf(stderr, "%s plugin: open (%s) failed: %s\n", w->name, w->file,
+            STRERRNO);
+  return fd;
+}
+
+static void log_writer_flush(c_log_writer_t *w, log_line_t *lines,
+                             size_t lines_num) {
+  char dropped_msg[128];
+  struct iovec iov[LOG_WRITER_BATCH + 1];
+  size_t iov_num = 0;
+
+  uint64_t dropped = __atomic_load_n(&w->dropped, __ATOMIC_RELAXED);
+  if (dropped != w->dropped_reported) {
+    int len = snprintf(dropped_msg, sizeof(dropped_msg),
+                       "%s plugin: %" PRIu64 " messages were dropped because "
+                       "the log queue was full.\n",
+                       w->name, dropped - w->dropped_reported);
+    iov[iov_num++] = (struct iovec){.iov_base = dropped_msg,
+                                    .iov_len = (size_t)len};
+    w->dropped_reported = dropped;
+  }
+
+  for (size_t i = 0; i < lines_num; i++)
+    iov[iov_num++] =
+        (struct iovec){.iov_base = lines[i].line, .iov_len = lines[i].len};
+
+  int fd = log_writer_open(w);
+  if (fd < 0)
+    return;
+
+  struct iovec *ptr = iov;
+  while (iov_num > 0) {
+    ssize_t status = writev(fd, ptr, (int)iov_num);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      fprintf(stderr, "%s plugin: writev failed: %s\n", w->name, STRERRNO);
+      break;
+    }
+
+    /* skip what has been written after a short write */
+    size_t written = (size_t)status;
+    while ((iov_num > 0) && (written >= ptr->iov_len)) {
+      written -= ptr->iov_len;
+      ptr++;
+      iov_num--;
+    }
+    if (iov_num > 0) {
+      ptr->iov_base = (char *)ptr->iov_base + written;
+      ptr->iov_len -= written;
+    }
+  }
+
+  if (w->file != NULL)
+    close(fd);
+}
+
+static void *log_writer_thread(void *arg) {
+  c_log_writer_t *w = arg;
+  log_line_t lines[LOG_WRITER_BATCH];
+  bool running = true;
+
+  while (running) {
+    size_t lines_num = 0;
+
+    if (c_ring_pop_wait(w->ring, &lines[0]) == 0)
+      lines_num++;
+    else
+      running = false; /* closed, write what is left and exit */
+
+    while ((lines_num < LOG_WRITER_BATCH) &&
+           (c_ring_pop(w->ring, &lines[lines_num]) == 0))
+      lines_num++;
+
+    if (lines_num == 0)
+      continue;
+
+    log_writer_flush(w, lines, lines_num);
+    for (size_t i = 0; i < lines_num; i++)
+      free(lines[i].line);
+
+    /* the ring was closed while there were more lines than fit a batch */
+    if (!running && (c_ring_size(w->ring) > 0))
+      running = true;
+  }
+
+  return NULL;
+}
+
+c_log_writer_t *c_log_writer_create(char const *name, char const *file,
+                                    size_t queue_size) {
+  if ((name == NULL) || (queue_size == 0))
+    return NULL;
+
+  c_log_writer_t *w = calloc(1, sizeof(*w));
+  if (w == NULL)
+    return NULL;
+
+  w->name = strdup(name);
+  if ((file == NULL) || (strcasecmp("stderr", file) == 0))
+    w->fd = STDERR_FILENO;
+  else if (strcasecmp("stdout", file) == 0)
+    w->fd = STDOUT_FILENO;
+  else
+    w->file = strdup(file);
+
+  w->ring = c_ring_create(queue_size, sizeof(log_line_t));
+  if ((w->name == NULL) || ((w->file == NULL) && (w->fd <= 0)) ||
+      (w->ring == NULL)) {
+    c_log_writer_destroy(w);
+    return NULL;
+  }
+
+  int status = pthread_create(&w->thread, /* attr = */ NULL, log_writer_thread,
+                              w);
+  if (status != 0) {
+    c_log_writer_destroy(w);
+    return NULL;
+  }
+  w->thread_started = true;
+
+#if HAVE_PTHREAD_SETNAME_NP
+  char thread_name[16];
+  sstrncpy(thread_name, name, sizeof(thread_name));
+  pthread_setname_np(w->thread, thread_name);
+#endif
+
+  return w;
+}
+
+void c_log_writer_destroy(c_log_writer_t *w) {
+  if (w == NULL)
+    return;
+
+  if (w->thread_started) {
+    c_ring_close(w->ring);
+    pthread_join(w->thread, NULL);
+  }
+
+  if (w->ring != NULL) {
+    log_line_t l;
+    while (c_ring_pop(w->ring, &l) == 0)
+      free(l.line);
+    c_ring_destroy(w->ring);
+  }
+
+  free(w->name);
+  free(w->file);
+  free(w);
+}
+
+int c_log_writer_write(c_log_writer_t *w, char const *line, size_t len) {
+  if ((w == NULL) || (line == NULL))
+    return EINVAL;
+
+  log_line_t l = {
+      .line = malloc(len),
+      .len = len,
+  };
+  if (l.line == NULL)
+    return ENOMEM;
+  memcpy(l.line, line, len);
+
+  if (c_ring_push(w->ring, &l) != 0) {
+    free(l.line);
+    __atomic_fetch_add(&w->dropped, 1, __ATOMIC_RELAXED);
+    return EAGAIN;
+  }
+
+  return 0;
+}
+
+uint64_t c_log_writer_dropped(c_log_writer_t *w) {
+  if (w == NULL)
+    return 0;
+  return __atomic_load_n(&w->dropped, __ATOMIC_RELAXED);
+}
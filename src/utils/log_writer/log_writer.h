@@ -0,0 +1,95 @@
+/**
+ * collectd - src/utils/log_writer/log_writer.h
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_LOG_WRITER_H
+#define UTILS_LOG_WRITER_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Asynchronous writer for log files. Threads hand preformatted lines to the
+ * writer, which copies them into a lock-free ring (see utils/ring/ring.h) and
+ * returns immediately. A single thread takes the lines off the ring and writes
+ * them to the file in batches with writev(2). Lines are dropped when the ring
+ * is full; the number of dropped lines is written to the file once there is
+ * room again.
+ */
+struct c_log_writer_s;
+typedef struct c_log_writer_s c_log_writer_t;
+
+/*
+ * NAME
+ *   c_log_writer_create
+ *
+ * DESCRIPTION
+ *   Allocates a new writer and starts its thread.
+ *
+ * PARAMETERS
+ *   `name'        Name of the owning plugin. Used as the thread's name and in
+ *                 the messages written by the writer itself.
+ *   `file'        File to append to. NULL and "stderr" select the standard
+ *                 error stream, "stdout" selects the standard output. Other
+ *                 files are reopened for each batch, so they may be rotated.
+ *   `queue_size'  Maximum number of lines waiting to be written.
+ *
+ * RETURN VALUE
+ *   A c_log_writer_t-pointer upon success or NULL upon failure.
+ */
+c_log_writer_t *c_log_writer_create(char const *name, char const *file,
+                                    size_t queue_size);
+
+/*
+ * NAME
+ *   c_log_writer_destroy
+ *
+ * DESCRIPTION
+ *   Writes all lines still waiting in the queue, stops the thread and
+ *   deallocates the writer. No other thread must be using the writer anymore.
+ */
+void c_log_writer_destroy(c_log_writer_t *w);
+
+/*
+ * NAME
+ *   c_log_writer_write
+ *
+ * DESCRIPTION
+ *   Queues a copy of the `len' bytes at `line'. The line should end in a
+ *   newline character. Does not block.
+ *
+ * RETURN VALUE
+ *   Zero upon success, EAGAIN if the queue is full and the line was dropped,
+ *   or an errno value upon failure.
+ */
+int c_log_writer_write(c_log_writer_t *w, char const *line, size_t len);
+
+/*
+ * NAME
+ *   c_log_writer_dropped
+ *
+ * DESCRIPTION
+ *   Returns the number of lines dropped since the writer was created.
+ */
+uint64_t c_log_writer_dropped(c_log_writer_t *w);
+
+#endif /* UTILS_LOG_WRITER_H */
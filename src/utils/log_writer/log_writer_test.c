@@ -0,0 +1,132 @@
+/**
+ * collectd - src/utils/log_writer/log_writer_test.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/log_writer/log_writer.h"
+
+static char *make_temp_file(char *buf, size_t size) {
+  snprintf(buf, size, "/tmp/log_writer_test.XXXXXX");
+  int fd = mkstemp(buf);
+  if (fd < 0)
+    return NULL;
+  close(fd);
+  return buf;
+}
+
+/* Counts the lines of "file", excluding the messages about dropped lines. */
+static int count_lines(char const *file, int *dropped_msgs) {
+  FILE *fh = fopen(file, "r");
+  if (fh == NULL)
+    return -1;
+
+  char line[256];
+  int num = 0;
+  *dropped_msgs = 0;
+  while (fgets(line, sizeof(line), fh) != NULL) {
+    if (strstr(line, "messages were dropped") != NULL)
+      (*dropped_msgs)++;
+    else
+      num++;
+  }
+  fclose(fh);
+  return num;
+}
+
+DEF_TEST(write) {
+  char file[64];
+  CHECK_NOT_NULL(make_temp_file(file, sizeof(file)));
+
+  c_log_writer_t *w;
+  CHECK_NOT_NULL(w = c_log_writer_create("test", file, 4096));
+
+  for (int i = 0; i < 1000; i++) {
+    char line[64];
+    int len = snprintf(line, sizeof(line), "line #%d\n", i);
+    EXPECT_EQ_INT(0, c_log_writer_write(w, line, (size_t)len));
+  }
+  EXPECT_EQ_UINT64(0, c_log_writer_dropped(w));
+
+  /* destroying the writer writes the remaining lines */
+  c_log_writer_destroy(w);
+
+  int dropped_msgs = 0;
+  EXPECT_EQ_INT(1000, count_lines(file, &dropped_msgs));
+  EXPECT_EQ_INT(0, dropped_msgs);
+
+  /* the lines are written in order */
+  FILE *fh = fopen(file, "r");
+  CHECK_NOT_NULL(fh);
+  char line[64];
+  for (int i = 0; i < 1000; i++) {
+    char want[64];
+    snprintf(want, sizeof(want), "line #%d\n", i);
+    CHECK_NOT_NULL(fgets(line, sizeof(line), fh));
+    EXPECT_EQ_STR(want, line);
+  }
+  fclose(fh);
+
+  unlink(file);
+  return 0;
+}
+
+DEF_TEST(drop) {
+  char file[64];
+  CHECK_NOT_NULL(make_temp_file(file, sizeof(file)));
+
+  c_log_writer_t *w;
+  CHECK_NOT_NULL(w = c_log_writer_create("test", file, 4));
+
+  int written = 0;
+  for (int i = 0; i < 10000; i++) {
+    if (c_log_writer_write(w, "line\n", strlen("line\n")) == 0)
+      written++;
+  }
+  uint64_t dropped = c_log_writer_dropped(w);
+  EXPECT_EQ_UINT64(10000, (uint64_t)written + dropped);
+
+  c_log_writer_destroy(w);
+
+  int dropped_msgs = 0;
+  EXPECT_EQ_INT(written, count_lines(file, &dropped_msgs));
+
+  unlink(file);
+  return 0;
+}
+
+DEF_TEST(invalid) {
+  EXPECT_EQ_PTR(NULL, c_log_writer_create(NULL, "stderr", 16));
+  EXPECT_EQ_PTR(NULL, c_log_writer_create("test", "stderr", 0));
+  EXPECT_EQ_INT(EINVAL, c_log_writer_write(NULL, "x\n", 2));
+  c_log_writer_destroy(NULL);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(write);
+  RUN_TEST(drop);
+  RUN_TEST(invalid);
+
+  END_TEST;
+}
@@ -72,8 +72,57 @@ struct identifier_match_s {
 };
 typedef struct identifier_match_s identifier_match_t;
 
+struct user_class_s;
+typedef struct user_class_s user_class_t;
+
+struct user_obj_s;
+typedef struct user_obj_s user_obj_t;
+
+/* One entry of the series cache: the result of matching one identifier
+ * against all user classes, i.e. the user objects the identifier's values are
+ * handed to. User objects are only freed by lookup_destroy(), so the cached
+ * pointers stay valid for the lifetime of the lookup object. */
+struct lu_match_s {
+  user_class_t *user_class;
+  user_obj_t *user_obj;
+};
+typedef struct lu_match_s lu_match_t;
+
+struct lu_cache_entry_s;
+typedef struct lu_cache_entry_s lu_cache_entry_t;
+struct lu_cache_entry_s {
+  uint64_t hash;
+  /* The identifier's fields, each including its terminating null byte. */
+  char *key;
+  size_t key_len;
+
+  lu_match_t *matches;
+  size_t matches_num;
+
+  lu_cache_entry_t *next;
+};
+
+/* The series cache is split into stripes, each with its own lock and hash
+ * table, so that concurrent write threads rarely contend. The upper bits of
+ * the identifier's hash select the stripe, the lower bits the bucket. */
+#define LU_CACHE_STRIPES_NUM 64
+#define LU_CACHE_STRIPE_MAX_ENTRIES 65536
+#define LU_CACHE_INITIAL_BUCKETS 64
+
+struct lu_cache_stripe_s {
+  pthread_mutex_t lock;
+  lu_cache_entry_t **buckets;
+  size_t buckets_num;
+  size_t entries_num;
+};
+typedef struct lu_cache_stripe_s lu_cache_stripe_t;
+
+/* Number of matches copied out of the cache without allocating memory. */
+#define LU_STATIC_MATCHES_NUM 16
+
 struct lookup_s {
   c_avl_tree_t *by_type_tree;
+  lu_cache_stripe_t cache[LU_CACHE_STRIPES_NUM];
 
   lookup_class_callback_t cb_user_class;
   lookup_obj_callback_t cb_user_obj;
@@ -81,8 +130,6 @@ struct lookup_s {
   lookup_free_obj_callback_t cb_free_obj;
 };
 
-struct user_obj_s;
-typedef struct user_obj_s user_obj_t;
 struct user_obj_s {
   void *user_obj;
   lookup_identifier_t ident;
@@ -94,9 +141,9 @@ struct user_class_s {
   pthread_mutex_t lock;
   void *user_class;
   identifier_match_t match;
-  user_obj_t *user_obj_list; /* list of user_obj */
+  user_obj_t *user_obj_list;    /* list of user_obj */
+  c_avl_tree_t *user_obj_tree; /* user_obj->ident -> user_obj */
 };
-typedef struct user_class_s user_class_t;
 
 struct user_class_list_s;
 typedef struct user_class_list_s user_class_list_t;
@@ -190,34 +237,43 @@ static int lu_copy_ident_to_match(identifier_match_t *match, /* {{{ */
   return 0;
 } /* }}} int lu_copy_ident_to_match */
 
-/* user_class->lock must be held when calling this function */
-static void *lu_create_user_obj(lookup_t *obj, /* {{{ */
-                                data_set_t const *ds, value_list_t const *vl,
-                                user_class_t *user_class) {
-  user_obj_t *user_obj;
+static int lu_ident_compare(void const *a, void const *b) /* {{{ */
+{
+  lookup_identifier_t const *ia = a;
+  lookup_identifier_t const *ib = b;
+  int status;
 
-  user_obj = calloc(1, sizeof(*user_obj));
-  if (user_obj == NULL) {
-    ERROR("utils_vl_lookup: calloc failed.");
-    return NULL;
-  }
-  user_obj->next = NULL;
+#define CMP_FIELD(field)                                                       \
+  do {                                                                         \
+    status = strcmp(ia->field, ib->field);                                     \
+    if (status != 0)                                                           \
+      return status;                                                           \
+  } while (0)
 
-  user_obj->user_obj = obj->cb_user_class(ds, vl, user_class->user_class);
-  if (user_obj->user_obj == NULL) {
-    sfree(user_obj);
-    WARNING("utils_vl_lookup: User-provided constructor failed.");
-    return NULL;
-  }
+  CMP_FIELD(host);
+  CMP_FIELD(plugin);
+  CMP_FIELD(plugin_instance);
+  CMP_FIELD(type);
+  CMP_FIELD(type_instance);
+
+#undef CMP_FIELD
 
+  return 0;
+} /* }}} int lu_ident_compare */
+
+/* Sets "ident" to the identifier of the user object "vl" belongs to: fields
+ * that are matched by a regular expression but not grouped by are set to
+ * "/.*\/", all other fields are copied from the value list. */
+static void lu_user_obj_ident(user_class_t const *user_class, /* {{{ */
+                              value_list_t const *vl,
+                              lookup_identifier_t *ident) {
 #define COPY_FIELD(field, group_mask)                                          \
   do {                                                                         \
     if (user_class->match.field.is_regex &&                                    \
         ((user_class->match.group_by & group_mask) == 0))                      \
-      sstrncpy(user_obj->ident.field, "/.*/", sizeof(user_obj->ident.field));  \
+      sstrncpy(ident->field, "/.*/", sizeof(ident->field));                    \
     else                                                                       \
-      sstrncpy(user_obj->ident.field, vl->field,                               \
-               sizeof(user_obj->ident.field));                                 \
+      sstrncpy(ident->field, vl->field, sizeof(ident->field));                 \
   } while (0)
 
   COPY_FIELD(host, LU_GROUP_BY_HOST);
@@ -227,6 +283,39 @@ static void *lu_create_user_obj(lookup_t *obj, /* {{{ */
   COPY_FIELD(type_instance, LU_GROUP_BY_TYPE_INSTANCE);
 
 #undef COPY_FIELD
+} /* }}} void lu_user_obj_ident */
+
+/* user_class->lock must be held when calling this function */
+static user_obj_t *lu_create_user_obj(lookup_t *obj, /* {{{ */
+                                      data_set_t const *ds,
+                                      value_list_t const *vl,
+                                      user_class_t *user_class,
+                                      lookup_identifier_t const *ident) {
+  user_obj_t *user_obj;
+
+  user_obj = calloc(1, sizeof(*user_obj));
+  if (user_obj == NULL) {
+    ERROR("utils_vl_lookup: calloc failed.");
+    return NULL;
+  }
+  user_obj->next = NULL;
+  memcpy(&user_obj->ident, ident, sizeof(user_obj->ident));
+
+  user_obj->user_obj = obj->cb_user_class(ds, vl, user_class->user_class);
+  if (user_obj->user_obj == NULL) {
+    sfree(user_obj);
+    WARNING("utils_vl_lookup: User-provided constructor failed.");
+    return NULL;
+  }
+
+  if (c_avl_insert(user_class->user_obj_tree, &user_obj->ident, user_obj) !=
+      0) {
+    ERROR("utils_vl_lookup: c_avl_insert failed.");
+    if (obj->cb_free_obj != NULL)
+      obj->cb_free_obj(user_obj->user_obj);
+    sfree(user_obj);
+    return NULL;
+  }
 
   if (user_class->user_obj_list == NULL) {
     user_class->user_obj_list = user_obj;
@@ -238,100 +327,261 @@ static void *lu_create_user_obj(lookup_t *obj, /* {{{ */
   }
 
   return user_obj;
-} /* }}} void *lu_create_user_obj */
-
-/* user_class->lock must be held when calling this function */
-static user_obj_t *lu_find_user_obj(user_class_t *user_class, /* {{{ */
-                                    value_list_t const *vl) {
-  user_obj_t *ptr;
-
-  for (ptr = user_class->user_obj_list; ptr != NULL; ptr = ptr->next) {
-    if (user_class->match.host.is_regex &&
-        (user_class->match.group_by & LU_GROUP_BY_HOST) &&
-        (strcmp(vl->host, ptr->ident.host) != 0))
-      continue;
-    if (user_class->match.plugin.is_regex &&
-        (user_class->match.group_by & LU_GROUP_BY_PLUGIN) &&
-        (strcmp(vl->plugin, ptr->ident.plugin) != 0))
-      continue;
-    if (user_class->match.plugin_instance.is_regex &&
-        (user_class->match.group_by & LU_GROUP_BY_PLUGIN_INSTANCE) &&
-        (strcmp(vl->plugin_instance, ptr->ident.plugin_instance) != 0))
-      continue;
-    if (user_class->match.type_instance.is_regex &&
-        (user_class->match.group_by & LU_GROUP_BY_TYPE_INSTANCE) &&
-        (strcmp(vl->type_instance, ptr->ident.type_instance) != 0))
-      continue;
-
-    return ptr;
-  }
-
-  return NULL;
-} /* }}} user_obj_t *lu_find_user_obj */
-
-static int lu_handle_user_class(lookup_t *obj, /* {{{ */
-                                data_set_t const *ds, value_list_t const *vl,
-                                user_class_t *user_class) {
-  user_obj_t *user_obj;
-  int status;
+} /* }}} user_obj_t *lu_create_user_obj */
+
+/* Returns the user object of "user_class" that "vl" belongs to, creating it if
+ * necessary. Returns NULL if "vl" is not matched by "user_class" (and sets
+ * "*status" to zero) or if creating the user object failed (and sets
+ * "*status" to -1). */
+static user_obj_t *lu_resolve_user_class(lookup_t *obj, /* {{{ */
+                                         data_set_t const *ds,
+                                         value_list_t const *vl,
+                                         user_class_t *user_class,
+                                         int *status) {
+  lookup_identifier_t ident;
+  user_obj_t *user_obj = NULL;
 
   assert(strcmp(vl->type, user_class->match.type.str) == 0);
   assert(user_class->match.plugin.is_regex ||
          (strcmp(vl->plugin, user_class->match.plugin.str)) == 0);
 
+  *status = 0;
   if (!lu_part_matches(&user_class->match.type_instance, vl->type_instance) ||
       !lu_part_matches(&user_class->match.plugin_instance,
                        vl->plugin_instance) ||
       !lu_part_matches(&user_class->match.plugin, vl->plugin) ||
       !lu_part_matches(&user_class->match.host, vl->host))
-    return 1;
+    return NULL;
+
+  lu_user_obj_ident(user_class, vl, &ident);
 
   pthread_mutex_lock(&user_class->lock);
-  user_obj = lu_find_user_obj(user_class, vl);
-  if (user_obj == NULL) {
+  if (c_avl_get(user_class->user_obj_tree, &ident, (void *)&user_obj) != 0) {
     /* call lookup_class_callback_t() and insert into the list of user objects.
      */
-    user_obj = lu_create_user_obj(obj, ds, vl, user_class);
-    if (user_obj == NULL) {
-      pthread_mutex_unlock(&user_class->lock);
-      return -1;
-    }
+    user_obj = lu_create_user_obj(obj, ds, vl, user_class, &ident);
+    if (user_obj == NULL)
+      *status = -1;
   }
   pthread_mutex_unlock(&user_class->lock);
 
-  status = obj->cb_user_obj(ds, vl, user_class->user_class, user_obj->user_obj);
-  if (status != 0) {
-    ERROR("utils_vl_lookup: The user object callback failed with status %i.",
-          status);
-    /* Returning a negative value means: abort! */
-    if (status < 0)
+  return user_obj;
+} /* }}} user_obj_t *lu_resolve_user_class */
+
+/* Appends the user objects of all classes in "user_class_list" that match
+ * "vl" to the "matches" array. */
+static int lu_resolve_user_class_list(lookup_t *obj, /* {{{ */
+                                      data_set_t const *ds,
+                                      value_list_t const *vl,
+                                      user_class_list_t *user_class_list,
+                                      lu_match_t **matches,
+                                      size_t *matches_num) {
+  for (user_class_list_t *ptr = user_class_list; ptr != NULL;
+       ptr = ptr->next) {
+    int status;
+
+    user_obj_t *user_obj =
+        lu_resolve_user_class(obj, ds, vl, &ptr->entry, &status);
+    if (status != 0)
       return status;
-    else
-      return 1;
+    if (user_obj == NULL)
+      continue;
+
+    lu_match_t *tmp = realloc(*matches, (*matches_num + 1) * sizeof(**matches));
+    if (tmp == NULL) {
+      ERROR("utils_vl_lookup: realloc failed.");
+      return -1;
+    }
+    *matches = tmp;
+    (*matches)[*matches_num] = (lu_match_t){
+        .user_class = &ptr->entry,
+        .user_obj = user_obj,
+    };
+    (*matches_num)++;
   }
 
   return 0;
-} /* }}} int lu_handle_user_class */
+} /* }}} int lu_resolve_user_class_list */
 
-static int lu_handle_user_class_list(lookup_t *obj, /* {{{ */
-                                     data_set_t const *ds,
-                                     value_list_t const *vl,
-                                     user_class_list_t *user_class_list) {
-  user_class_list_t *ptr;
+/* Calls the user object callback for each match. Returns the number of
+ * successful calls or a negative value if a callback asked to abort. */
+static int lu_handle_matches(lookup_t *obj, /* {{{ */
+                             data_set_t const *ds, value_list_t const *vl,
+                             lu_match_t const *matches, size_t matches_num) {
   int retval = 0;
 
-  for (ptr = user_class_list; ptr != NULL; ptr = ptr->next) {
-    int status;
+  for (size_t i = 0; i < matches_num; i++) {
+    int status = obj->cb_user_obj(ds, vl, matches[i].user_class->user_class,
+                                  matches[i].user_obj->user_obj);
+    if (status == 0) {
+      retval++;
+      continue;
+    }
 
-    status = lu_handle_user_class(obj, ds, vl, &ptr->entry);
+    ERROR("utils_vl_lookup: The user object callback failed with status %i.",
+          status);
+    /* Returning a negative value means: abort! */
     if (status < 0)
       return status;
-    else if (status == 0)
-      retval++;
   }
 
   return retval;
-} /* }}} int lu_handle_user_class_list */
+} /* }}} int lu_handle_matches */
+
+/*
+ * Series cache
+ */
+/* Serializes the identifier's fields, including their terminating null bytes,
+ * into "buffer". Returns the number of bytes used. */
+static size_t lu_cache_key(char *buffer, size_t buffer_size, /* {{{ */
+                           value_list_t const *vl) {
+  char const *fields[] = {vl->host, vl->plugin, vl->plugin_instance, vl->type,
+                          vl->type_instance};
+  size_t offset = 0;
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(fields); i++) {
+    size_t len = strnlen(fields[i], DATA_MAX_NAME_LEN - 1);
+    assert(offset + len + 1 <= buffer_size);
+    memcpy(buffer + offset, fields[i], len);
+    buffer[offset + len] = 0;
+    offset += len + 1;
+  }
+
+  return offset;
+} /* }}} size_t lu_cache_key */
+
+static lu_cache_stripe_t *lu_cache_stripe(lookup_t *obj, /* {{{ */
+                                          uint64_t hash) {
+  return obj->cache + ((hash >> 32) % LU_CACHE_STRIPES_NUM);
+} /* }}} lu_cache_stripe_t *lu_cache_stripe */
+
+/* stripe->lock must be held when calling this function */
+static lu_cache_entry_t *lu_cache_find(lu_cache_stripe_t *stripe, /* {{{ */
+                                       uint64_t hash, char const *key,
+                                       size_t key_len) {
+  if (stripe->buckets_num == 0)
+    return NULL;
+
+  for (lu_cache_entry_t *ce = stripe->buckets[hash & (stripe->buckets_num - 1)];
+       ce != NULL; ce = ce->next) {
+    if ((ce->hash == hash) && (ce->key_len == key_len) &&
+        (memcmp(ce->key, key, key_len) == 0))
+      return ce;
+  }
+
+  return NULL;
+} /* }}} lu_cache_entry_t *lu_cache_find */
+
+/* stripe->lock must be held when calling this function */
+static void lu_cache_clear(lu_cache_stripe_t *stripe) /* {{{ */
+{
+  for (size_t i = 0; i < stripe->buckets_num; i++) {
+    while (stripe->buckets[i] != NULL) {
+      lu_cache_entry_t *ce = stripe->buckets[i];
+      stripe->buckets[i] = ce->next;
+
+      sfree(ce->key);
+      sfree(ce->matches);
+      sfree(ce);
+    }
+  }
+  sfree(stripe->buckets);
+  stripe->buckets_num = 0;
+  stripe->entries_num = 0;
+} /* }}} void lu_cache_clear */
+
+/* stripe->lock must be held when calling this function */
+static int lu_cache_grow(lu_cache_stripe_t *stripe) /* {{{ */
+{
+  size_t buckets_num = (stripe->buckets_num == 0) ? LU_CACHE_INITIAL_BUCKETS
+                                                  : 2 * stripe->buckets_num;
+  lu_cache_entry_t **buckets = calloc(buckets_num, sizeof(*buckets));
+  if (buckets == NULL)
+    return ENOMEM;
+
+  for (size_t i = 0; i < stripe->buckets_num; i++) {
+    while (stripe->buckets[i] != NULL) {
+      lu_cache_entry_t *ce = stripe->buckets[i];
+      stripe->buckets[i] = ce->next;
+
+      size_t j = ce->hash & (buckets_num - 1);
+      ce->next = buckets[j];
+      buckets[j] = ce;
+    }
+  }
+
+  sfree(stripe->buckets);
+  stripe->buckets = buckets;
+  stripe->buckets_num = buckets_num;
+  return 0;
+} /* }}} int lu_cache_grow */
+
+/* Stores the result of a full lookup in the cache. Takes ownership of
+ * "matches". Failing to cache is not an error: the next lookup of the same
+ * identifier will simply do a full lookup again. */
+static void lu_cache_insert(lookup_t *obj, uint64_t hash, /* {{{ */
+                            char const *key, size_t key_len,
+                            lu_match_t *matches, size_t matches_num) {
+  lu_cache_stripe_t *stripe = lu_cache_stripe(obj, hash);
+
+  lu_cache_entry_t *ce = calloc(1, sizeof(*ce));
+  if (ce == NULL) {
+    sfree(matches);
+    return;
+  }
+  ce->key = malloc(key_len);
+  if (ce->key == NULL) {
+    sfree(ce);
+    sfree(matches);
+    return;
+  }
+  memcpy(ce->key, key, key_len);
+  ce->key_len = key_len;
+  ce->hash = hash;
+  ce->matches = matches;
+  ce->matches_num = matches_num;
+
+  pthread_mutex_lock(&stripe->lock);
+
+  /* Another thread may have resolved the same identifier concurrently. */
+  if (lu_cache_find(stripe, hash, key, key_len) != NULL) {
+    pthread_mutex_unlock(&stripe->lock);
+    sfree(ce->key);
+    sfree(ce->matches);
+    sfree(ce);
+    return;
+  }
+
+  /* Bound the memory used for identifiers that have gone away. */
+  if (stripe->entries_num >= LU_CACHE_STRIPE_MAX_ENTRIES)
+    lu_cache_clear(stripe);
+
+  if ((stripe->entries_num >= stripe->buckets_num) &&
+      (lu_cache_grow(stripe) != 0) && (stripe->buckets_num == 0)) {
+    pthread_mutex_unlock(&stripe->lock);
+    sfree(ce->key);
+    sfree(ce->matches);
+    sfree(ce);
+    return;
+  }
+
+  size_t i = hash & (stripe->buckets_num - 1);
+  ce->next = stripe->buckets[i];
+  stripe->buckets[i] = ce;
+  stripe->entries_num++;
+
+  pthread_mutex_unlock(&stripe->lock);
+} /* }}} void lu_cache_insert */
+
+/* Drops all cached lookup results, e.g. because a user class was added. */
+static void lu_cache_flush(lookup_t *obj) /* {{{ */
+{
+  for (size_t i = 0; i < LU_CACHE_STRIPES_NUM; i++) {
+    pthread_mutex_lock(&obj->cache[i].lock);
+    lu_cache_clear(obj->cache + i);
+    pthread_mutex_unlock(&obj->cache[i].lock);
+  }
+} /* }}} void lu_cache_flush */
 
 static by_type_entry_t *lu_search_by_type(lookup_t *obj, /* {{{ */
                                           char const *type,
@@ -479,6 +729,9 @@ static void lu_destroy_user_class_list(lookup_t *obj, /* {{{ */
 
 #undef CLEAR_FIELD
 
+    /* The tree's keys point into the user objects. */
+    c_avl_destroy(user_class_list->entry.user_obj_tree);
+    user_class_list->entry.user_obj_tree = NULL;
     lu_destroy_user_obj(obj, user_class_list->entry.user_obj_list);
     user_class_list->entry.user_obj_list = NULL;
     pthread_mutex_destroy(&user_class_list->entry.lock);
@@ -536,6 +789,9 @@ lookup_t *lookup_create(lookup_class_callback_t cb_user_class, /* {{{ */
     return NULL;
   }
 
+  for (size_t i = 0; i < LU_CACHE_STRIPES_NUM; i++)
+    pthread_mutex_init(&obj->cache[i].lock, /* attr = */ NULL);
+
   obj->cb_user_class = cb_user_class;
   obj->cb_user_obj = cb_user_obj;
   obj->cb_free_class = cb_free_class;
@@ -551,6 +807,11 @@ void lookup_destroy(lookup_t *obj) /* {{{ */
   if (obj == NULL)
     return;
 
+  for (size_t i = 0; i < LU_CACHE_STRIPES_NUM; i++) {
+    lu_cache_clear(obj->cache + i);
+    pthread_mutex_destroy(&obj->cache[i].lock);
+  }
+
   while (42) {
     char *type = NULL;
     by_type_entry_t *by_type = NULL;
@@ -585,46 +846,104 @@ int lookup_add(lookup_t *obj, /* {{{ */
     ERROR("utils_vl_lookup: calloc failed.");
     return ENOMEM;
   }
+  user_class_obj->entry.user_obj_tree = c_avl_create(lu_ident_compare);
+  if (user_class_obj->entry.user_obj_tree == NULL) {
+    ERROR("utils_vl_lookup: c_avl_create failed.");
+    sfree(user_class_obj);
+    return ENOMEM;
+  }
   pthread_mutex_init(&user_class_obj->entry.lock, /* attr = */ NULL);
   user_class_obj->entry.user_class = user_class;
   lu_copy_ident_to_match(&user_class_obj->entry.match, ident, group_by);
   user_class_obj->entry.user_obj_list = NULL;
   user_class_obj->next = NULL;
 
+  /* Cached results don't include the new class. */
+  lu_cache_flush(obj);
+
   return lu_add_by_plugin(by_type, user_class_obj);
 } /* }}} int lookup_add */
 
-/* returns the number of successful calls to the callback function */
-int lookup_search(lookup_t *obj, /* {{{ */
-                  data_set_t const *ds, value_list_t const *vl) {
+/* Matches "vl" against all user classes and returns the matching user
+ * objects in "ret_matches". The array is allocated and must be freed by the
+ * caller. */
+static int lu_resolve(lookup_t *obj, data_set_t const *ds, /* {{{ */
+                      value_list_t const *vl, lu_match_t **ret_matches,
+                      size_t *ret_matches_num) {
   by_type_entry_t *by_type = NULL;
   user_class_list_t *user_class_list = NULL;
-  int retval = 0;
-  int status;
+  lu_match_t *matches = NULL;
+  size_t matches_num = 0;
+  int status = 0;
 
+  by_type = lu_search_by_type(obj, vl->type, /* allocate = */ false);
+  if (by_type != NULL) {
+    if (c_avl_get(by_type->by_plugin_tree, vl->plugin,
+                  (void *)&user_class_list) == 0)
+      status = lu_resolve_user_class_list(obj, ds, vl, user_class_list,
+                                          &matches, &matches_num);
+
+    if ((status == 0) && (by_type->wildcard_plugin_list != NULL))
+      status = lu_resolve_user_class_list(
+          obj, ds, vl, by_type->wildcard_plugin_list, &matches, &matches_num);
+  }
+
+  if (status != 0) {
+    sfree(matches);
+    return status;
+  }
+
+  *ret_matches = matches;
+  *ret_matches_num = matches_num;
+  return 0;
+} /* }}} int lu_resolve */
+
+/* returns the number of successful calls to the callback function */
+int lookup_search(lookup_t *obj, /* {{{ */
+                  data_set_t const *ds, value_list_t const *vl) {
   if ((obj == NULL) || (ds == NULL) || (vl == NULL))
     return -EINVAL;
 
-  by_type = lu_search_by_type(obj, vl->type, /* allocate = */ false);
-  if (by_type == NULL)
-    return 0;
+  char key[5 * DATA_MAX_NAME_LEN];
+  size_t key_len = lu_cache_key(key, sizeof(key), vl);
+  uint64_t hash = HASH_VL(vl);
+  lu_cache_stripe_t *stripe = lu_cache_stripe(obj, hash);
 
-  status =
-      c_avl_get(by_type->by_plugin_tree, vl->plugin, (void *)&user_class_list);
-  if (status == 0) {
-    status = lu_handle_user_class_list(obj, ds, vl, user_class_list);
-    if (status < 0)
-      return status;
-    retval += status;
+  lu_match_t static_matches[LU_STATIC_MATCHES_NUM] = {{0}};
+  lu_match_t *matches = NULL;
+  size_t matches_num = 0;
+  bool found = false;
+  int status;
+
+  /* Copy the cached result so the callbacks run without holding the stripe's
+   * lock. */
+  pthread_mutex_lock(&stripe->lock);
+  lu_cache_entry_t *ce = lu_cache_find(stripe, hash, key, key_len);
+  if (ce != NULL) {
+    matches = static_matches;
+    if (ce->matches_num > STATIC_ARRAY_SIZE(static_matches))
+      matches = malloc(ce->matches_num * sizeof(*matches));
+    if (matches != NULL) {
+      if (ce->matches_num > 0)
+        memcpy(matches, ce->matches, ce->matches_num * sizeof(*matches));
+      matches_num = ce->matches_num;
+      found = true;
+    }
   }
+  pthread_mutex_unlock(&stripe->lock);
 
-  if (by_type->wildcard_plugin_list != NULL) {
-    status =
-        lu_handle_user_class_list(obj, ds, vl, by_type->wildcard_plugin_list);
-    if (status < 0)
+  if (!found) {
+    status = lu_resolve(obj, ds, vl, &matches, &matches_num);
+    if (status != 0)
       return status;
-    retval += status;
+
+    status = lu_handle_matches(obj, ds, vl, matches, matches_num);
+    lu_cache_insert(obj, hash, key, key_len, matches, matches_num);
+    return status;
   }
 
-  return retval;
+  status = lu_handle_matches(obj, ds, vl, matches, matches_num);
+  if (matches != static_matches)
+    sfree(matches);
+  return status;
 } /* }}} lookup_search */
@@ -78,10 +78,16 @@ lookup_t *lookup_create(lookup_class_callback_t, lookup_obj_callback_t,
                         lookup_free_obj_callback_t);
 void lookup_destroy(lookup_t *obj);
 
+/* Adds a user class. Not safe to call concurrently with lookup_search(). */
 int lookup_add(lookup_t *obj, lookup_identifier_t const *ident,
                unsigned int group_by, void *user_class);
 
-/* TODO(octo): Pass lookup_obj_callback_t to lookup_search()? */
+/* Hands "vl" to the user objects of all matching user classes and returns the
+ * number of successful callbacks. The matching user objects are cached per
+ * identifier, so only the first lookup of an identifier walks the user
+ * classes and evaluates regular expressions. Safe to call from multiple
+ * threads.
+ * TODO(octo): Pass lookup_obj_callback_t to lookup_search()? */
 int lookup_search(lookup_t *obj, data_set_t const *ds, value_list_t const *vl);
 
 #endif /* UTILS_VL_LOOKUP_H */
@@ -231,12 +231,59 @@ DEF_TEST(regex) {
   return 0;
 }
 
+DEF_TEST(cached_lookups) {
+  lookup_t *obj;
+  CHECK_NOT_NULL(obj = lookup_create(lookup_class_callback, lookup_obj_callback,
+                                     (void *)free, (void *)free));
+
+  checked_lookup_add(obj, "/.*/", "cpu", "/.*/", "test", "/.*/",
+                     LU_GROUP_BY_HOST);
+
+  /* Repeated lookups of the same identifier are served from the cache and
+   * must reach the same user object. */
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ_INT(1, checked_lookup_search(obj, "host0", "cpu", "0", "test",
+                                           "user", /* expect new = */ i == 0));
+    EXPECT_EQ_STR("host0", last_obj_ident.host);
+  }
+
+  /* Non-matching identifiers are cached, too. */
+  for (int i = 0; i < 2; i++)
+    EXPECT_EQ_INT(0, checked_lookup_search(obj, "host0", "memory", "", "test",
+                                           "used", /* expect new = */ 0));
+
+  /* Identifiers whose string representations collide must not share cache
+   * entries. */
+  EXPECT_EQ_INT(1, checked_lookup_search(obj, "host0", "cpu", "0-user", "test",
+                                         "", /* expect new = */ 0));
+  EXPECT_EQ_INT(0, checked_lookup_search(obj, "host0", "cpu-0", "user", "test",
+                                         "", /* expect new = */ 0));
+
+  /* Adding a class invalidates cached results. */
+  checked_lookup_add(obj, "/.*/", "memory", "", "test", "/.*/",
+                     LU_GROUP_BY_TYPE_INSTANCE);
+  EXPECT_EQ_INT(1, checked_lookup_search(obj, "host0", "memory", "", "test",
+                                         "used", /* expect new = */ 1));
+  EXPECT_EQ_INT(1, checked_lookup_search(obj, "host0", "cpu", "0", "test",
+                                         "user", /* expect new = */ 0));
+
+  /* Callback failures are reported for cached lookups as well. */
+  for (int i = 0; i < 2; i++)
+    EXPECT_EQ_INT(-1, checked_lookup_search(obj, "host1", "cpu", "failure",
+                                            "test", "user",
+                                            /* expect new = */ i == 0));
+
+  lookup_destroy(obj);
+  return 0;
+}
+
 int main(int argc, char **argv) /* {{{ */
 {
   RUN_TEST(group_by_specific_host);
   RUN_TEST(group_by_any_host);
   RUN_TEST(multiple_lookups);
   RUN_TEST(regex);
+  RUN_TEST(cached_lookups);
 
   END_TEST;
 } /* }}} int main */
@@ -41,6 +41,9 @@ struct cu_match_s {
   regex_t excluderegex;
   int flags;
 
+  /* Literal string every line matching "regex" must contain, or NULL. */
+  char *literal;
+
   int (*callback)(const char *str, char *const *matches, size_t matches_num,
                   void *user_data);
   void *user_data;
@@ -50,6 +53,144 @@ struct cu_match_s {
 /*
  * Private functions
  */
+
+/* Skips the bracket expression starting at "regex[0]" and returns a pointer
+ * to the closing bracket, or NULL if the expression is not terminated. */
+static const char *match_skip_bracket(const char *regex) { /* {{{ */
+  const char *ptr = regex + 1;
+
+  if (*ptr == '^')
+    ptr++;
+  /* A leading ']' is part of the list. */
+  if (*ptr == ']')
+    ptr++;
+
+  while (*ptr != 0) {
+    if ((ptr[0] == '[') &&
+        ((ptr[1] == ':') || (ptr[1] == '.') || (ptr[1] == '='))) {
+      char delim = ptr[1];
+      ptr += 2;
+      while ((*ptr != 0) && !((ptr[0] == delim) && (ptr[1] == ']')))
+        ptr++;
+      if (*ptr == 0)
+        return NULL;
+      ptr += 2;
+      continue;
+    }
+    if (*ptr == ']')
+      return ptr;
+    ptr++;
+  }
+
+  return NULL;
+} /* }}} const char *match_skip_bracket */
+
+/* Returns the longest run of literal characters that is part of every string
+ * matching the extended regular expression "regex", or NULL if there is none.
+ * The scan is conservative: alternations disable the prefilter entirely,
+ * groups, bracket expressions and non-ASCII characters end a run and
+ * quantified characters are dropped from it. */
+static char *match_required_literal(const char *regex) { /* {{{ */
+  size_t regex_len = strlen(regex);
+  char run[regex_len + 1];
+  size_t run_len = 0;
+  char best[regex_len + 1];
+  size_t best_len = 0;
+  int depth = 0;
+  /* Whether the previous atom was appended to "run". */
+  bool prev_literal = false;
+
+#define END_RUN()                                                              \
+  do {                                                                         \
+    if (run_len > best_len) {                                                  \
+      memcpy(best, run, run_len);                                              \
+      best_len = run_len;                                                      \
+    }                                                                          \
+    run_len = 0;                                                               \
+    prev_literal = false;                                                      \
+  } while (0)
+
+  for (const char *ptr = regex; *ptr != 0; ptr++) {
+    char c = *ptr;
+
+    switch (c) {
+    case '|':
+      return NULL;
+
+    case '(':
+      depth++;
+      END_RUN();
+      break;
+
+    case ')':
+      depth--;
+      END_RUN();
+      break;
+
+    case '[':
+      ptr = match_skip_bracket(ptr);
+      if (ptr == NULL)
+        return NULL;
+      END_RUN();
+      break;
+
+    case '*':
+    case '?':
+    case '{':
+      /* The previous atom may not be there at all. */
+      if (prev_literal)
+        run_len--;
+      END_RUN();
+      if (c == '{') {
+        while ((ptr[1] != 0) && (ptr[1] != '}'))
+          ptr++;
+        if (ptr[1] == 0)
+          return NULL;
+        ptr++;
+      }
+      break;
+
+    case '+':
+      /* The previous atom is there at least once. */
+      END_RUN();
+      break;
+
+    case '.':
+    case '^':
+    case '$':
+      END_RUN();
+      break;
+
+    case '\\':
+      ptr++;
+      c = *ptr;
+      if (c == 0)
+        return NULL;
+      /* "\w", "\b", "\<" and friends are GNU extensions, not literals. */
+      if (isalnum((unsigned char)c) || (c == '<') || (c == '>') ||
+          (c == '`') || (c == '\'') || ((unsigned char)c >= 0x80)) {
+        END_RUN();
+        break;
+      }
+      /* fall through */
+    default:
+      if ((depth != 0) || ((unsigned char)c >= 0x80)) {
+        END_RUN();
+        break;
+      }
+      run[run_len++] = c;
+      prev_literal = true;
+    }
+  }
+  END_RUN();
+#undef END_RUN
+
+  if (best_len == 0)
+    return NULL;
+
+  best[best_len] = 0;
+  return strdup(best);
+} /* }}} char *match_required_literal */
 static char *match_substr(const char *str, int begin, int end) {
   char *ret;
   size_t ret_len;
@@ -236,12 +377,15 @@ match_create_callback(const char *regex, const char *excluderegex,
     return NULL;
   }
   obj->flags |= UTILS_MATCH_FLAGS_REGEX;
+  obj->literal = match_required_literal(regex);
 
   if (excluderegex && strcmp(excluderegex, "") != 0) {
     status = regcomp(&obj->excluderegex, excluderegex, REG_EXTENDED);
     if (status != 0) {
       ERROR("Compiling the excluding regular expression \"%s\" failed.",
             excluderegex);
+      regfree(&obj->regex);
+      sfree(obj->literal);
       sfree(obj);
       return NULL;
     }
@@ -307,6 +451,7 @@ void match_destroy(cu_match_t *obj) {
     regfree(&obj->regex);
   if (obj->flags & UTILS_MATCH_FLAGS_EXCLUDE_REGEX)
     regfree(&obj->excluderegex);
+  sfree(obj->literal);
   if ((obj->user_data != NULL) && (obj->free != NULL))
     (*obj->free)(obj->user_data);
 
@@ -322,15 +467,20 @@ int match_apply(cu_match_t *obj, const char *str) {
   if ((obj == NULL) || (str == NULL))
     return -1;
 
-  if (obj->flags & UTILS_MATCH_FLAGS_EXCLUDE_REGEX) {
-    status =
-        regexec(&obj->excluderegex, str, STATIC_ARRAY_SIZE(re_match), re_match,
-                /* eflags = */ 0);
+  /* Most lines don't match at all: reject them with a substring search
+   * before running the regular expression, and run it without sub-matches
+   * first since extracting them is considerably more expensive. */
+  if ((obj->literal != NULL) && (strstr(str, obj->literal) == NULL))
+    return 0;
+
+  if (regexec(&obj->regex, str, 0, NULL, /* eflags = */ 0) != 0)
+    return 0;
+
+  if ((obj->flags & UTILS_MATCH_FLAGS_EXCLUDE_REGEX) &&
+      (regexec(&obj->excluderegex, str, 0, NULL, /* eflags = */ 0) == 0)) {
     /* Regex did match, so exclude this line */
-    if (status == 0) {
-      DEBUG("ExludeRegex matched, don't count that line\n");
-      return 0;
-    }
+    DEBUG("ExludeRegex matched, don't count that line\n");
+    return 0;
   }
 
   status = regexec(&obj->regex, str, STATIC_ARRAY_SIZE(re_match), re_match,
@@ -0,0 +1,116 @@
+/**
+ * collectd - src/utils/match/match_test.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/common/common.h"
+#include "utils/match/match.h"
+
+#include <regex.h>
+
+typedef struct {
+  int calls;
+  char submatch[64];
+} hits_t;
+
+static int count_hits(const char __attribute__((unused)) * str,
+                      char *const *matches, size_t matches_num,
+                      void *user_data) {
+  hits_t *h = user_data;
+
+  h->calls++;
+  sstrncpy(h->submatch, (matches_num > 1) ? matches[1] : matches[0],
+           sizeof(h->submatch));
+  return 0;
+}
+
+/* Every line must be reported exactly when regexec(3) matches it, no matter
+ * which literal the prefilter picked from the regular expression. */
+DEF_TEST(prefilter) {
+  char const *regexes[] = {
+      "foo",          "^foo bar$",     "fo+o",         "ab*c",
+      "abc?d",        "x(yz)*w",       "(foo|bar)baz", "foo|bar",
+      "a[]b]c",       "a[[:digit:]]b", "a\\.b",         "a\\wb",
+      "a{2}b",        "ab{0,1}c",      "(a(b)c)d",      "a.c",
+      "\\(literal\\)",
+  };
+  char const *lines[] = {
+      "foo",   "foo bar", "fooo",   "ac",     "abbbc",  "abd",
+      "abcd",  "xw",      "xyzyzw", "barbaz", "bar",    "a]c",
+      "abc",   "a5b",     "a.b",    "axb",    "a_b",    "aab",
+      "ab",    "abd",     "abcd",   "a-c",    "(literal)",
+      "",      "zzz",
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(regexes); i++) {
+    regex_t re;
+    CHECK_ZERO(regcomp(&re, regexes[i], REG_EXTENDED | REG_NEWLINE));
+
+    hits_t h = {0};
+    cu_match_t *m =
+        match_create_callback(regexes[i], NULL, count_hits, &h, NULL);
+    CHECK_NOT_NULL(m);
+
+    for (size_t j = 0; j < STATIC_ARRAY_SIZE(lines); j++) {
+      int want = (regexec(&re, lines[j], 0, NULL, 0) == 0) ? 1 : 0;
+
+      h.calls = 0;
+      CHECK_ZERO(match_apply(m, lines[j]));
+      if (h.calls != want)
+        printf("# regex \"%s\", line \"%s\"\n", regexes[i], lines[j]);
+      EXPECT_EQ_INT(want, h.calls);
+    }
+
+    match_destroy(m);
+    regfree(&re);
+  }
+
+  return 0;
+}
+
+DEF_TEST(exclude) {
+  hits_t h = {0};
+  cu_match_t *m = match_create_callback("status=([0-9]+)", "debug", count_hits,
+                                        &h, NULL);
+  CHECK_NOT_NULL(m);
+
+  CHECK_ZERO(match_apply(m, "info status=200"));
+  EXPECT_EQ_INT(1, h.calls);
+  EXPECT_EQ_STR("200", h.submatch);
+
+  CHECK_ZERO(match_apply(m, "debug status=500"));
+  CHECK_ZERO(match_apply(m, "info state=500"));
+  EXPECT_EQ_INT(1, h.calls);
+  EXPECT_EQ_STR("200", h.submatch);
+
+  match_destroy(m);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(prefilter);
+  RUN_TEST(exclude);
+
+  END_TEST;
+}
@@ -0,0 +1,143 @@
+/**
+ * collectd - src/utils/memo/memo.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/memo/memo.h"
+
+#define MEMO_LOCKS 64
+
+/* The key and the value are stored back to back after the header. */
+typedef struct {
+  uint64_t hash;
+  char *value;
+  char key[];
+} memo_entry_t;
+
+struct c_memo_s {
+  memo_entry_t **slots;
+  size_t mask;
+  pthread_mutex_t locks[MEMO_LOCKS];
+};
+
+/* 64-bit FNV-1a */
+static uint64_t memo_hash(char const *s) {
+  uint64_t h = UINT64_C(14695981039346656037);
+  for (; *s != 0; s++) {
+    h ^= (uint64_t)(unsigned char)*s;
+    h *= UINT64_C(1099511628211);
+  }
+  return h;
+} /* uint64_t memo_hash */
+
+c_memo_t *c_memo_create(size_t size) {
+  size_t n = 2;
+  while (n < size) {
+    if (n > (SIZE_MAX / 2))
+      return NULL;
+    n *= 2;
+  }
+
+  c_memo_t *m = calloc(1, sizeof(*m));
+  if (m == NULL)
+    return NULL;
+
+  m->slots = calloc(n, sizeof(*m->slots));
+  if (m->slots == NULL) {
+    free(m);
+    return NULL;
+  }
+  m->mask = n - 1;
+
+  for (size_t i = 0; i < MEMO_LOCKS; i++)
+    pthread_mutex_init(m->locks + i, /* attr = */ NULL);
+
+  return m;
+} /* c_memo_t *c_memo_create */
+
+void c_memo_destroy(c_memo_t *m) {
+  if (m == NULL)
+    return;
+
+  for (size_t i = 0; i <= m->mask; i++)
+    free(m->slots[i]);
+  for (size_t i = 0; i < MEMO_LOCKS; i++)
+    pthread_mutex_destroy(m->locks + i);
+  free(m->slots);
+  free(m);
+} /* void c_memo_destroy */
+
+int c_memo_get(c_memo_t *m, char const *key, char *buffer,
+               size_t buffer_size) {
+  uint64_t hash = memo_hash(key);
+  size_t slot = (size_t)hash & m->mask;
+  pthread_mutex_t *lock = m->locks + (slot % MEMO_LOCKS);
+  int status = ENOENT;
+
+  pthread_mutex_lock(lock);
+  memo_entry_t *e = m->slots[slot];
+  if ((e != NULL) && (e->hash == hash) && (strcmp(e->key, key) == 0)) {
+    if (buffer_size > 0) {
+      size_t len = strlen(e->value);
+      if (len >= buffer_size)
+        len = buffer_size - 1;
+      memcpy(buffer, e->value, len);
+      buffer[len] = 0;
+    }
+    status = 0;
+  }
+  pthread_mutex_unlock(lock);
+
+  return status;
+} /* int c_memo_get */
+
+int c_memo_put(c_memo_t *m, char const *key, char const *value) {
+  size_t key_len = strlen(key) + 1;
+  size_t value_len = strlen(value) + 1;
+
+  memo_entry_t *e = malloc(sizeof(*e) + key_len + value_len);
+  if (e == NULL)
+    return ENOMEM;
+
+  e->hash = memo_hash(key);
+  memcpy(e->key, key, key_len);
+  e->value = e->key + key_len;
+  memcpy(e->value, value, value_len);
+
+  size_t slot = (size_t)e->hash & m->mask;
+  pthread_mutex_t *lock = m->locks + (slot % MEMO_LOCKS);
+
+  pthread_mutex_lock(lock);
+  memo_entry_t *old = m->slots[slot];
+  m->slots[slot] = e;
+  pthread_mutex_unlock(lock);
+
+  free(old);
+  return 0;
+} /* int c_memo_put */
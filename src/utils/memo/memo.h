@@ -0,0 +1,90 @@
+/**
+ * collectd - src/utils/memo/memo.h
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_MEMO_H
+#define UTILS_MEMO_H 1
+
+#include <stddef.h>
+
+/*
+ * Bounded cache mapping strings to strings, used to remember the result of
+ * an expensive string rewrite, e.g. a regular expression substitution. It is
+ * direct mapped: a new entry replaces the one stored in its slot, so memory
+ * use is fixed and lookups never search. All functions are thread-safe; the
+ * slots are protected by a small set of striped locks.
+ */
+struct c_memo_s;
+typedef struct c_memo_s c_memo_t;
+
+/*
+ * NAME
+ *   c_memo_create
+ *
+ * DESCRIPTION
+ *   Allocates a new, empty cache.
+ *
+ * PARAMETERS
+ *   `size'  Number of entries. Rounded up to the next power of two.
+ *
+ * RETURN VALUE
+ *   A c_memo_t-pointer upon success or NULL upon failure.
+ */
+c_memo_t *c_memo_create(size_t size);
+
+/*
+ * NAME
+ *   c_memo_destroy
+ *
+ * DESCRIPTION
+ *   Deallocates a cache and all its entries.
+ */
+void c_memo_destroy(c_memo_t *m);
+
+/*
+ * NAME
+ *   c_memo_get
+ *
+ * DESCRIPTION
+ *   Copies the value stored for `key' into `buffer', truncating it to
+ *   `buffer_size' bytes.
+ *
+ * RETURN VALUE
+ *   Zero if `key' was found, ENOENT otherwise.
+ */
+int c_memo_get(c_memo_t *m, char const *key, char *buffer,
+               size_t buffer_size);
+
+/*
+ * NAME
+ *   c_memo_put
+ *
+ * DESCRIPTION
+ *   Stores `value' for `key', replacing the entry previously stored in the
+ *   same slot.
+ *
+ * RETURN VALUE
+ *   Zero upon success, ENOMEM if allocating the entry failed.
+ */
+int c_memo_put(c_memo_t *m, char const *key, char const *value);
+
+#endif /* UTILS_MEMO_H */
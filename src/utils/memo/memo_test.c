@@ -0,0 +1,89 @@
+/**
+ * collectd - src/utils/memo/memo_test.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/memo/memo.h"
+
+DEF_TEST(get_put) {
+  c_memo_t *m;
+  char buffer[16];
+
+  CHECK_NOT_NULL(m = c_memo_create(8));
+  EXPECT_EQ_INT(ENOENT, c_memo_get(m, "foo", buffer, sizeof(buffer)));
+
+  CHECK_ZERO(c_memo_put(m, "foo", "bar"));
+  CHECK_ZERO(c_memo_get(m, "foo", buffer, sizeof(buffer)));
+  EXPECT_EQ_STR("bar", buffer);
+  EXPECT_EQ_INT(ENOENT, c_memo_get(m, "fo", buffer, sizeof(buffer)));
+
+  /* replacing an entry */
+  CHECK_ZERO(c_memo_put(m, "foo", ""));
+  CHECK_ZERO(c_memo_get(m, "foo", buffer, sizeof(buffer)));
+  EXPECT_EQ_STR("", buffer);
+
+  /* values are truncated to the buffer */
+  CHECK_ZERO(c_memo_put(m, "long", "0123456789abcdefghij"));
+  CHECK_ZERO(c_memo_get(m, "long", buffer, sizeof(buffer)));
+  EXPECT_EQ_STR("0123456789abcde", buffer);
+
+  c_memo_destroy(m);
+  return 0;
+}
+
+DEF_TEST(eviction) {
+  c_memo_t *m;
+  char key[16];
+  char buffer[16];
+
+  CHECK_NOT_NULL(m = c_memo_create(4));
+
+  /* More keys than slots: every lookup either misses or returns the value
+   * stored for exactly this key. */
+  for (int i = 0; i < 100; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    CHECK_ZERO(c_memo_put(m, key, key + 3));
+  }
+
+  int found = 0;
+  for (int i = 0; i < 100; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    if (c_memo_get(m, key, buffer, sizeof(buffer)) != 0)
+      continue;
+    EXPECT_EQ_STR(key + 3, buffer);
+    found++;
+  }
+  OK(found > 0);
+  OK(found <= 4);
+
+  c_memo_destroy(m);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(get_put);
+  RUN_TEST(eviction);
+
+  END_TEST;
+}
@@ -0,0 +1,113 @@
+/**
+ * collectd - src/utils/memstats/memstats.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "utils/memstats/memstats.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Owners are kept in a fixed array so that readers do not need a lock. Once
+ * it is full, further plugins share the last entry. */
+#define MEMSTATS_DAEMON "daemon"
+#define MEMSTATS_OTHER "other"
+
+static memstats_owner_t owners[MEMSTATS_OWNERS_MAX];
+static size_t owners_num;
+static pthread_mutex_t owners_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static memstats_name_cb current_name;
+
+/* Plugin names are stable for the lifetime of the daemon, so the last lookup
+ * of each thread is remembered by the name's address. */
+static __thread char const *cached_name;
+static __thread memstats_owner_t *cached_owner;
+
+static memstats_owner_t *owner_get(char const *name) {
+  memstats_owner_t *o = NULL;
+
+  pthread_mutex_lock(&owners_lock);
+  for (size_t i = 0; i < owners_num; i++) {
+    if (strcmp(owners[i].name, name) == 0) {
+      o = owners + i;
+      break;
+    }
+  }
+
+  if ((o == NULL) && (owners_num < MEMSTATS_OWNERS_MAX)) {
+    char *copy = strdup((owners_num == MEMSTATS_OWNERS_MAX - 1) ? MEMSTATS_OTHER
+                                                                 : name);
+    if (copy != NULL) {
+      o = owners + owners_num;
+      o->name = copy;
+      __atomic_store_n(&owners_num, owners_num + 1, __ATOMIC_RELEASE);
+    }
+  }
+  if ((o == NULL) && (owners_num > 0))
+    o = owners + owners_num - 1;
+  pthread_mutex_unlock(&owners_lock);
+
+  return o;
+}
+
+void memstats_enable(memstats_name_cb name_cb) {
+  __atomic_store_n(&current_name, name_cb, __ATOMIC_RELEASE);
+}
+
+bool memstats_enabled(void) {
+  return __atomic_load_n(&current_name, __ATOMIC_ACQUIRE) != NULL;
+}
+
+memstats_owner_t *memstats_owner_current(void) {
+  memstats_name_cb name_cb = __atomic_load_n(&current_name, __ATOMIC_ACQUIRE);
+  if (name_cb == NULL)
+    return NULL;
+
+  char const *name = name_cb();
+  if (name == NULL)
+    name = MEMSTATS_DAEMON;
+
+  if ((cached_owner != NULL) && (cached_name == name))
+    return cached_owner;
+
+  memstats_owner_t *o = owner_get(name);
+  if (o != NULL) {
+    cached_name = name;
+    cached_owner = o;
+  }
+  return o;
+}
+
+size_t memstats_read(memstats_report_t *report, size_t num) {
+  size_t n = __atomic_load_n(&owners_num, __ATOMIC_ACQUIRE);
+
+  for (size_t i = 0; (i < n) && (i < num); i++) {
+    report[i] = (memstats_report_t){
+        .name = owners[i].name,
+        .bytes = __atomic_load_n(&owners[i].bytes, __ATOMIC_RELAXED),
+        .objects = __atomic_load_n(&owners[i].objects, __ATOMIC_RELAXED),
+    };
+  }
+
+  return n;
+}
@@ -0,0 +1,114 @@
+/**
+ * collectd - src/utils/memstats/memstats.h
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_MEMSTATS_H
+#define UTILS_MEMSTATS_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Accounting of the memory held by containers, per owning plugin. A container
+ * looks up its owner with memstats_owner_current() when it is created, keeps
+ * the pointer and reports every allocation and deallocation to it, no matter
+ * which thread makes it. Owners are never freed.
+ *
+ * Accounting is off until memstats_enable() is called. Until then
+ * memstats_owner_current() returns NULL and containers created with a NULL
+ * owner are never accounted, so the counters never see frees of memory whose
+ * allocation they missed.
+ *
+ * There is a single set of counters per process: only the daemon links this
+ * library, plugins use the daemon's symbols, including the containers they
+ * link themselves.
+ */
+struct memstats_owner_s {
+  char *name;
+  int64_t bytes;
+  int64_t objects;
+};
+typedef struct memstats_owner_s memstats_owner_t;
+
+/* Returns the name of the plugin the calling thread is working for, or NULL
+ * for the daemon itself. */
+typedef char const *(*memstats_name_cb)(void);
+
+/*
+ * NAME
+ *   memstats_enable
+ *
+ * DESCRIPTION
+ *   Starts accounting. `name_cb' is used to attribute containers created from
+ *   now on to the plugin that creates them; memory created outside of any
+ *   plugin is attributed to "daemon".
+ */
+void memstats_enable(memstats_name_cb name_cb);
+
+/* Returns true once memstats_enable() has been called. */
+bool memstats_enabled(void);
+
+/*
+ * NAME
+ *   memstats_owner_current
+ *
+ * DESCRIPTION
+ *   Returns the owner for allocations of the calling thread, or NULL if
+ *   accounting is disabled.
+ */
+memstats_owner_t *memstats_owner_current(void);
+
+/* Adds `bytes' and `objects', which may be negative, to the counters of
+ * `owner'. Does nothing if `owner' is NULL. */
+static inline void memstats_add(memstats_owner_t *owner, int64_t bytes,
+                                int64_t objects) {
+  if (owner == NULL)
+    return;
+  __atomic_add_fetch(&owner->bytes, bytes, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&owner->objects, objects, __ATOMIC_RELAXED);
+}
+
+/* Maximum number of owners. Owners beyond the last but one share an entry
+ * called "other". */
+#define MEMSTATS_OWNERS_MAX 256
+
+typedef struct {
+  char const *name;
+  int64_t bytes;
+  int64_t objects;
+} memstats_report_t;
+
+/*
+ * NAME
+ *   memstats_read
+ *
+ * DESCRIPTION
+ *   Copies the counters of up to `num' owners to `report', in the order the
+ *   owners were first used.
+ *
+ * RETURN VALUE
+ *   The number of owners, which may be larger than `num'.
+ */
+size_t memstats_read(memstats_report_t *report, size_t num);
+
+#endif /* UTILS_MEMSTATS_H */
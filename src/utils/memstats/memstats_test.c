@@ -0,0 +1,147 @@
+/**
+ * collectd - src/utils/memstats/memstats_test.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/avltree/avltree.h"
+#include "utils/common/common.h"
+#include "utils/memstats/memstats.h"
+#include "utils_llist.h"
+
+static char const *test_name;
+
+static char const *test_name_cb(void) { return test_name; }
+
+static memstats_report_t const *find(memstats_report_t const *report,
+                                     size_t num, char const *name) {
+  for (size_t i = 0; i < num; i++)
+    if (strcmp(name, report[i].name) == 0)
+      return report + i;
+  return NULL;
+}
+
+DEF_TEST(disabled) {
+  EXPECT_EQ_INT(0, memstats_enabled());
+  EXPECT_EQ_PTR(NULL, memstats_owner_current());
+
+  /* Containers created now are never accounted. */
+  llist_t *l = llist_create();
+  llist_append(l, llentry_create("a", NULL));
+
+  memstats_enable(test_name_cb);
+  EXPECT_EQ_INT(1, memstats_enabled());
+
+  memstats_report_t report[MEMSTATS_OWNERS_MAX];
+  llist_destroy(l);
+  EXPECT_EQ_UINT64(0, memstats_read(report, STATIC_ARRAY_SIZE(report)));
+  return 0;
+}
+
+DEF_TEST(owners) {
+  memstats_enable(test_name_cb);
+
+  test_name = NULL;
+  memstats_owner_t *daemon = memstats_owner_current();
+  CHECK_NOT_NULL(daemon);
+  EXPECT_EQ_STR("daemon", daemon->name);
+
+  /* Names are compared by content, the cache only by address. */
+  char name[] = "test";
+  test_name = name;
+  memstats_owner_t *o = memstats_owner_current();
+  CHECK_NOT_NULL(o);
+  EXPECT_EQ_STR("test", o->name);
+  test_name = "test";
+  EXPECT_EQ_PTR(o, memstats_owner_current());
+  test_name = NULL;
+  EXPECT_EQ_PTR(daemon, memstats_owner_current());
+
+  memstats_add(o, 100, 2);
+  memstats_add(o, -40, -1);
+  memstats_add(NULL, 1, 1);
+
+  memstats_report_t report[MEMSTATS_OWNERS_MAX];
+  size_t num = memstats_read(report, STATIC_ARRAY_SIZE(report));
+  EXPECT_EQ_UINT64(2, num);
+  memstats_report_t const *r = find(report, num, "test");
+  OK(r != NULL);
+  EXPECT_EQ_INT(60, r->bytes);
+  EXPECT_EQ_INT(1, r->objects);
+
+  memstats_add(o, -60, -1);
+  return 0;
+}
+
+DEF_TEST(containers) {
+  memstats_enable(test_name_cb);
+
+  test_name = "list";
+  llist_t *l = llist_create();
+  CHECK_NOT_NULL(l);
+  test_name = "tree";
+  c_avl_tree_t *t = c_avl_create((int (*)(const void *, const void *))strcmp);
+  CHECK_NOT_NULL(t);
+
+  /* The containers keep their owner, even if they are used elsewhere. */
+  test_name = NULL;
+  char *keys[] = {"a", "b", "c", "d"};
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(keys); i++) {
+    llist_append(l, llentry_create(keys[i], NULL));
+    CHECK_ZERO(c_avl_insert(t, keys[i], NULL));
+  }
+
+  memstats_report_t report[MEMSTATS_OWNERS_MAX];
+  size_t num = memstats_read(report, STATIC_ARRAY_SIZE(report));
+  memstats_report_t const *r = find(report, num, "list");
+  OK(r != NULL);
+  EXPECT_EQ_INT(1 + STATIC_ARRAY_SIZE(keys), r->objects);
+  /* The tree and its first node. */
+  r = find(report, num, "tree");
+  OK(r != NULL);
+  EXPECT_EQ_INT(2, r->objects);
+
+  llentry_t *e = llist_search(l, "b");
+  llist_remove(l, e);
+  llentry_destroy(e);
+  num = memstats_read(report, STATIC_ARRAY_SIZE(report));
+  r = find(report, num, "list");
+  EXPECT_EQ_INT(STATIC_ARRAY_SIZE(keys), r->objects);
+
+  llist_destroy(l);
+  c_avl_destroy(t);
+  num = memstats_read(report, STATIC_ARRAY_SIZE(report));
+  for (size_t i = 0; i < num; i++) {
+    EXPECT_EQ_INT(0, report[i].bytes);
+    EXPECT_EQ_INT(0, report[i].objects);
+  }
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(disabled);
+  RUN_TEST(owners);
+  RUN_TEST(containers);
+
+  END_TEST;
+}
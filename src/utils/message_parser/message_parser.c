@@ -32,12 +32,16 @@
 #include "plugin.h"
 #include "utils/common/common.h"
 
+#include "utils/match/match.h"
 #include "utils/message_parser/message_parser.h"
+#include "utils/tail/tail.h"
 
 #define UTIL_NAME "utils_message_parser"
 
 #define MSG_STOR_INIT_LEN 64
-#define MSG_STOR_INC_STEP 10
+/* Upper bound for the message buffer. The buffer grows by doubling up to this
+ * size and is reused across reads instead of being shrunk again. */
+#define MSG_STOR_MAX_LEN 4096
 
 typedef struct checked_match_s {
   parser_job_data_t *parser_job;
@@ -49,7 +53,9 @@ struct parser_job_data_s {
   const char *filename;
   unsigned int start_idx;
   unsigned int stop_idx;
-  cu_tail_match_t *tm;
+  cu_tail_t *tail;
+  /* Precompiled matches, indexed like message_patterns */
+  cu_match_t **matches;
   message_t *messages_storage;
   size_t messages_max_len;
   int message_idx;
@@ -64,6 +70,13 @@ struct parser_job_data_s {
                                 char *const *matches);
 };
 
+static bool message_in_progress(parser_job_data_t const *self) {
+  return self->message_idx >= 0 &&
+         (size_t)self->message_idx < self->messages_max_len &&
+         self->messages_storage[self->message_idx].started &&
+         !self->messages_storage[self->message_idx].completed;
+}
+
 static void message_item_assembly(parser_job_data_t *self, checked_match_t *cm,
                                   char *const *matches) {
   message_item_t *msg_it = &self->messages_storage[self->message_idx]
@@ -78,9 +91,7 @@ static void message_item_assembly(parser_job_data_t *self, checked_match_t *cm,
 
 static int start_message_assembly(parser_job_data_t *self) {
   /* Remove previous message assembly if unfinished */
-  if (self->message_idx >= 0 &&
-      self->messages_storage[self->message_idx].started == true &&
-      self->messages_storage[self->message_idx].completed == false) {
+  if (message_in_progress(self)) {
     DEBUG(UTIL_NAME ": Removing unfinished assembly of previous message");
     self->messages_storage[self->message_idx] = (message_t){{{{0}}}};
     self->message_item_idx = 0;
@@ -91,8 +102,11 @@ static int start_message_assembly(parser_job_data_t *self) {
   if (self->message_idx >= self->messages_max_len) {
     INFO(UTIL_NAME ": Exceeded message buffer size: %zu",
          self->messages_max_len);
-    if (self->resize_message_buffer(self, self->messages_max_len +
-                                              MSG_STOR_INC_STEP) != 0) {
+    size_t new_size = 2 * self->messages_max_len;
+    if (new_size > MSG_STOR_MAX_LEN)
+      new_size = MSG_STOR_MAX_LEN;
+    if (new_size <= self->messages_max_len ||
+        self->resize_message_buffer(self, new_size) != 0) {
       ERROR(UTIL_NAME ": Insufficient message buffer size: %zu. Remaining "
                       "messages for this read will be skipped",
             self->messages_max_len);
@@ -137,8 +151,9 @@ static void end_message_assembly(parser_job_data_t *self) {
           self->message_patterns[i].regex);
       self->messages_storage[self->message_idx] = (message_t){{{{0}}}};
       self->message_item_idx = 0;
-      if (self->message_idx > 0)
-        --(self->message_idx);
+      /* Hand the slot to the next message so that completed messages stay
+       * contiguous from index 0 */
+      --(self->message_idx);
       return;
     }
   }
@@ -172,8 +187,7 @@ static int message_assembler(const char *row, char *const *matches,
 
   /* Every matched start pattern resets current message items and starts
    * assembling new messages */
-  if (strcmp(cm->msg_pattern.regex,
-             parser_job->message_patterns[parser_job->start_idx].regex) == 0) {
+  if ((unsigned int)cm->msg_pattern_idx == parser_job->start_idx) {
     DEBUG(UTIL_NAME ": Found beginning pattern");
     if (parser_job->start_message_assembly(parser_job) != 0)
       return -1;
@@ -195,14 +209,37 @@ static int message_assembler(const char *row, char *const *matches,
       .matched_patterns_check[cm->msg_pattern_idx] = 1;
 
   /* Handle message ending */
-  if (strcmp(cm->msg_pattern.regex,
-             parser_job->message_patterns[parser_job->stop_idx].regex) == 0) {
+  if ((unsigned int)cm->msg_pattern_idx == parser_job->stop_idx) {
     DEBUG(UTIL_NAME ": Found ending pattern");
     parser_job->end_message_assembly(parser_job);
   }
   return 0;
 }
 
+/* Line callback for cu_tail_read(). Until a message has been started only the
+ * start pattern can have any effect, so the regular expressions of the other
+ * stages are not evaluated at all for lines between messages. */
+static int message_parser_line(void *data, char *buf,
+                               int __attribute__((unused)) buflen) {
+  parser_job_data_t *self = data;
+
+  for (size_t i = 0; i < self->message_patterns_len; i++) {
+    if (i != self->start_idx && !message_in_progress(self))
+      continue;
+    match_apply(self->matches[i], buf);
+  }
+  return 0;
+}
+
+static void message_parser_matches_destroy(parser_job_data_t *self) {
+  if (self->matches == NULL)
+    return;
+  for (size_t i = 0; i < self->message_patterns_len; i++)
+    if (self->matches[i] != NULL)
+      match_destroy(self->matches[i]);
+  sfree(self->matches);
+}
+
 parser_job_data_t *message_parser_init(const char *filename,
                                        unsigned int start_idx,
                                        unsigned int stop_idx,
@@ -239,12 +276,18 @@ parser_job_data_t *message_parser_init(const char *filename,
   memcpy(parser_job->message_patterns, message_patterns,
          sizeof(*parser_job->message_patterns) * message_patterns_len);
   parser_job->message_patterns_len = message_patterns_len;
-  /* Init tail match */
-  parser_job->tm = tail_match_create(parser_job->filename);
-  if (parser_job->tm == NULL) {
-    ERROR(UTIL_NAME ": Error creating tail match");
+  /* Init tail */
+  parser_job->tail = cu_tail_create(parser_job->filename);
+  if (parser_job->tail == NULL) {
+    ERROR(UTIL_NAME ": Error creating tail");
     goto free_msg_storage;
   }
+  parser_job->matches =
+      calloc(message_patterns_len, sizeof(*parser_job->matches));
+  if (parser_job->matches == NULL) {
+    ERROR(UTIL_NAME ": Error allocating matches");
+    goto free_tail;
+  }
 
   for (size_t i = 0; i < message_patterns_len; i++) {
     /* Create current_match container for passing regex info
@@ -252,29 +295,28 @@ parser_job_data_t *message_parser_init(const char *filename,
     checked_match_t *current_match = calloc(1, sizeof(*current_match));
     if (current_match == NULL) {
       ERROR(UTIL_NAME ": Error allocating current_match");
-      goto free_tail_match;
+      goto free_matches;
     }
     current_match->parser_job = parser_job;
     current_match->msg_pattern = message_patterns[i];
     current_match->msg_pattern_idx = i;
     /* Create callback */
-    cu_match_t *m = match_create_callback(
+    parser_job->matches[i] = match_create_callback(
         message_patterns[i].regex, message_patterns[i].excluderegex,
         message_assembler, current_match, free);
-    if (m == NULL) {
+    if (parser_job->matches[i] == NULL) {
       ERROR(UTIL_NAME ": Error creating match callback");
-      goto free_tail_match;
-    }
-    if (tail_match_add_match(parser_job->tm, m, 0, 0, 0) != 0) {
-      ERROR(UTIL_NAME ": Error adding match callback");
-      goto free_tail_match;
+      sfree(current_match);
+      goto free_matches;
     }
   }
 
   return parser_job;
 
-free_tail_match:
-  tail_match_destroy(parser_job->tm);
+free_matches:
+  message_parser_matches_destroy(parser_job);
+free_tail:
+  cu_tail_destroy(parser_job->tail);
 free_msg_storage:
   sfree(parser_job->messages_storage);
 free_msg_patterns:
@@ -292,44 +334,37 @@ int message_parser_read(parser_job_data_t *parser_job,
     return -1;
   }
   parser_job->messages_completed = 0;
-  bool incomplete_msg_found = false;
   /* Finish incomplete message assembly in this read */
-  if (parser_job->message_idx >= 0 &&
-      parser_job->messages_storage[parser_job->message_idx].started &&
-      !(parser_job->messages_storage[parser_job->message_idx].completed)) {
+  if (message_in_progress(parser_job)) {
     INFO(UTIL_NAME ": Found incomplete message from previous read.");
-    incomplete_msg_found = true;
-    message_t tmp_message =
-        parser_job->messages_storage[parser_job->message_idx];
-    int tmp_message_item_idx = parser_job->message_item_idx;
-    memset(parser_job->messages_storage, 0,
-           parser_job->messages_max_len *
-               sizeof(*parser_job->messages_storage));
-    memcpy(parser_job->messages_storage, &tmp_message,
-           sizeof(*parser_job->messages_storage));
-    parser_job->message_item_idx = tmp_message_item_idx;
+    /* Only the slots used by the previous read need to be cleared */
+    if (parser_job->message_idx > 0) {
+      parser_job->messages_storage[0] =
+          parser_job->messages_storage[parser_job->message_idx];
+      memset(parser_job->messages_storage + 1, 0,
+             parser_job->message_idx * sizeof(*parser_job->messages_storage));
+    }
     parser_job->message_idx = 0;
   }
   /* Reset message buffer after non empty read */
   else if (parser_job->message_idx >= 0) {
+    size_t used = (size_t)parser_job->message_idx + 1;
+    if (used > parser_job->messages_max_len)
+      used = parser_job->messages_max_len;
     memset(parser_job->messages_storage, 0,
-           parser_job->messages_max_len *
-               sizeof(*parser_job->messages_storage));
+           used * sizeof(*parser_job->messages_storage));
     parser_job->message_item_idx = 0;
     parser_job->message_idx = -1;
   }
 
-  int status = tail_match_read(parser_job->tm, force_rewind);
+  char buffer[4096];
+  int status = cu_tail_read(parser_job->tail, buffer, sizeof(buffer),
+                            message_parser_line, parser_job, force_rewind);
   if (status != 0) {
     ERROR(UTIL_NAME ": Error while parser read. Status: %d", status);
     return -1;
   }
 
-  /* Restore initial message buffer size if there's nothing to parse */
-  if (parser_job->messages_completed == 0 &&
-      parser_job->messages_max_len > MSG_STOR_INIT_LEN && !incomplete_msg_found)
-    parser_job->resize_message_buffer(parser_job, MSG_STOR_INIT_LEN);
-
   *messages_storage = parser_job->messages_storage;
   return parser_job->messages_completed;
 }
@@ -339,9 +374,10 @@ void message_parser_cleanup(parser_job_data_t *parser_job) {
     ERROR(UTIL_NAME ": Invalid parser_job pointer");
     return;
   }
+  message_parser_matches_destroy(parser_job);
   sfree(parser_job->messages_storage);
   sfree(parser_job->message_patterns);
-  if (parser_job->tm)
-    tail_match_destroy(parser_job->tm);
+  if (parser_job->tail)
+    cu_tail_destroy(parser_job->tail);
   sfree(parser_job);
 }
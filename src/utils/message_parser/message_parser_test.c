@@ -169,7 +169,7 @@ DEF_TEST(start_msg_item_assembly_3) {
   EXPECT_EQ_STR(TEST_MSG_ITEM_VAL,
                 job->messages_storage[0].message_items[0].value);
   EXPECT_EQ_INT(0, job->message_item_idx);
-  EXPECT_EQ_INT(1 + MSG_STOR_INC_STEP, job->messages_max_len);
+  EXPECT_EQ_INT(2, job->messages_max_len);
   EXPECT_EQ_INT(0, ret);
   sfree(job->messages_storage);
   sfree(job);
@@ -368,10 +368,7 @@ DEF_TEST(msg_parser_init) {
             sizeof(message_pattern_t) * TEST_PATTERNS_LEN) == 0);
   OK(job->message_patterns_len == TEST_PATTERNS_LEN);
 
-  sfree(job->messages_storage);
-  sfree(job->message_patterns);
-  tail_match_destroy(job->tm);
-  sfree(job);
+  message_parser_cleanup(job);
 
   return 0;
 }
@@ -412,13 +409,13 @@ DEF_TEST(msg_parser_read_2) {
   job->messages_completed = 0;
   job->message_patterns = patterns;
   job->message_patterns_len = TEST_PATTERNS_LEN;
-  job->tm = tail_match_create(job->filename);
+  job->tail = cu_tail_create(job->filename);
 
   int ret = message_parser_read(job, NULL, 0);
 
   EXPECT_EQ_INT(-1, ret);
 
-  tail_match_destroy(job->tm);
+  cu_tail_destroy(job->tail);
   sfree(job);
 
   return 0;
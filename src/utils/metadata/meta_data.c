@@ -28,10 +28,10 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/memstats/memstats.h"
 #include "utils/metadata/meta_data.h"
 
 #define MD_MAX_NONSTRING_CHARS 128
-
 /*
  * Data types
  */
@@ -47,17 +47,41 @@ typedef union meta_value_u meta_value_t;
 struct meta_entry_s;
 typedef struct meta_entry_s meta_entry_t;
 struct meta_entry_s {
-  char *key;
+  char const *key; /* interned, see md_key_intern() */
   meta_value_t value;
   int type;
-  meta_entry_t *next;
 };
 
+/* The entries of a meta data object, stored in one contiguous block. Clones
+ * share the block until one of them is modified (copy on write), so a block
+ * with more than one reference is never modified. */
+struct meta_block_s {
+  memstats_owner_t *owner;
+  unsigned int refs;
+  size_t entries_num;
+  size_t entries_size; /* number of entries allocated */
+  meta_entry_t entries[];
+};
+typedef struct meta_block_s meta_block_t;
+
 struct meta_data_s {
-  meta_entry_t *head;
+  meta_block_t *block; /* NULL if there are no entries */
   pthread_mutex_t lock;
+  memstats_owner_t *owner;
+  bool placed; /* memory owned by the caller, see meta_data_clone_at() */
 };
 
+/* Keys are interned: every distinct key is stored once for the lifetime of
+ * the process, so entries and copies of entries don't need to duplicate it.
+ * The set of keys used by plugins is small and fixed. */
+static pthread_mutex_t md_keys_lock = PTHREAD_MUTEX_INITIALIZER;
+static char **md_keys;
+static size_t md_keys_size; /* always a power of two */
+static size_t md_keys_num;
+
+#define MD_KEYS_SIZE_MIN 64
+#define MD_BLOCK_SIZE_MIN 4
+
 /*
  * Private functions
  */
@@ -79,198 +103,240 @@ static char *md_strdup(const char *orig) /* {{{ */
   return dest;
 } /* }}} char *md_strdup */
 
-static meta_entry_t *md_entry_alloc(const char *key) /* {{{ */
+/* FNV-1a */
+static uint64_t md_key_hash(char const *key) /* {{{ */
 {
-  meta_entry_t *e;
+  uint64_t hash = 14695981039346656037ULL;
 
-  e = calloc(1, sizeof(*e));
-  if (e == NULL) {
-    ERROR("md_entry_alloc: calloc failed.");
-    return NULL;
+  for (unsigned char const *c = (unsigned char const *)key; *c != 0; c++) {
+    hash ^= (uint64_t)*c;
+    hash *= 1099511628211ULL;
   }
 
-  e->key = md_strdup(key);
-  if (e->key == NULL) {
-    free(e);
-    ERROR("md_entry_alloc: md_strdup failed.");
-    return NULL;
-  }
+  return hash;
+} /* }}} uint64_t md_key_hash */
 
-  e->type = 0;
-  e->next = NULL;
+/* Must hold `md_keys_lock' when calling. */
+static int md_keys_resize(size_t size) /* {{{ */
+{
+  char **keys = calloc(size, sizeof(*keys));
+  if (keys == NULL)
+    return ENOMEM;
+
+  for (size_t i = 0; i < md_keys_size; i++) {
+    if (md_keys[i] == NULL)
+      continue;
+
+    size_t pos = md_key_hash(md_keys[i]) & (size - 1);
+    while (keys[pos] != NULL)
+      pos = (pos + 1) & (size - 1);
+    keys[pos] = md_keys[i];
+  }
 
-  return e;
-} /* }}} meta_entry_t *md_entry_alloc */
+  free(md_keys);
+  md_keys = keys;
+  md_keys_size = size;
+  return 0;
+} /* }}} int md_keys_resize */
 
-/* XXX: The lock on md must be held while calling this function! */
-static meta_entry_t *md_entry_clone_contents(const meta_entry_t *orig) /* {{{ */
+/* Returns the interned copy of `key', or NULL if memory is exhausted. */
+static char const *md_key_intern(char const *key) /* {{{ */
 {
-  meta_entry_t *copy;
-
-  /* WARNINGS :
-   *  - we do not check that orig != NULL here. You should have done it before.
-   *  - we do not set copy->next. DO NOT FORGET TO SET copy->next IN YOUR
-   * FUNCTION
-   */
+  pthread_mutex_lock(&md_keys_lock);
 
-  copy = md_entry_alloc(orig->key);
-  if (copy == NULL)
+  if ((2 * (md_keys_num + 1) > md_keys_size) &&
+      (md_keys_resize((md_keys_size > 0) ? 2 * md_keys_size
+                                         : MD_KEYS_SIZE_MIN) != 0)) {
+    pthread_mutex_unlock(&md_keys_lock);
+    ERROR("md_key_intern: md_keys_resize failed.");
     return NULL;
-  copy->type = orig->type;
-  if (copy->type == MD_TYPE_STRING)
-    copy->value.mv_string = strdup(orig->value.mv_string);
-  else
-    copy->value = orig->value;
-
-  return copy;
-} /* }}} meta_entry_t *md_entry_clone_contents */
+  }
 
-static meta_entry_t *md_entry_clone(const meta_entry_t *orig) /* {{{ */
-{
-  meta_entry_t *copy;
+  size_t pos = md_key_hash(key) & (md_keys_size - 1);
+  while (md_keys[pos] != NULL) {
+    if (strcmp(key, md_keys[pos]) == 0) {
+      pthread_mutex_unlock(&md_keys_lock);
+      return md_keys[pos];
+    }
+    pos = (pos + 1) & (md_keys_size - 1);
+  }
 
-  if (orig == NULL)
+  md_keys[pos] = md_strdup(key);
+  if (md_keys[pos] == NULL) {
+    pthread_mutex_unlock(&md_keys_lock);
+    ERROR("md_key_intern: md_strdup failed.");
     return NULL;
+  }
+  md_keys_num++;
 
-  copy = md_entry_clone_contents(orig);
-
-  copy->next = md_entry_clone(orig->next);
-  return copy;
-} /* }}} meta_entry_t *md_entry_clone */
+  char const *ret = md_keys[pos];
+  pthread_mutex_unlock(&md_keys_lock);
+  return ret;
+} /* }}} char const *md_key_intern */
 
-static void md_entry_free(meta_entry_t *e) /* {{{ */
+static void md_entry_free_value(meta_entry_t *e) /* {{{ */
 {
-  if (e == NULL)
-    return;
-
-  free(e->key);
-
   if (e->type == MD_TYPE_STRING)
     free(e->value.mv_string);
+} /* }}} void md_entry_free_value */
 
-  if (e->next != NULL)
-    md_entry_free(e->next);
+static int md_entry_copy(meta_entry_t *dest, meta_entry_t const *src) /* {{{ */
+{
+  *dest = *src;
+  if (src->type != MD_TYPE_STRING)
+    return 0;
 
-  free(e);
-} /* }}} void md_entry_free */
+  dest->value.mv_string = md_strdup(src->value.mv_string);
+  if (dest->value.mv_string == NULL) {
+    ERROR("md_entry_copy: md_strdup failed.");
+    return -ENOMEM;
+  }
+  return 0;
+} /* }}} int md_entry_copy */
 
-static int md_entry_insert(meta_data_t *md, meta_entry_t *e) /* {{{ */
+static meta_block_t *md_block_alloc(size_t entries_size) /* {{{ */
 {
-  meta_entry_t *this;
-  meta_entry_t *prev;
+  meta_block_t *b = calloc(1, sizeof(*b) + entries_size * sizeof(b->entries[0]));
+  if (b == NULL) {
+    ERROR("md_block_alloc: calloc failed.");
+    return NULL;
+  }
 
-  if ((md == NULL) || (e == NULL))
-    return -EINVAL;
+  b->owner = memstats_owner_current();
+  b->refs = 1;
+  b->entries_size = entries_size;
+  memstats_add(b->owner,
+               (int64_t)(sizeof(*b) + entries_size * sizeof(b->entries[0])), 1);
+  return b;
+} /* }}} meta_block_t *md_block_alloc */
 
-  pthread_mutex_lock(&md->lock);
+static void md_block_unref(meta_block_t *b) /* {{{ */
+{
+  if (b == NULL)
+    return;
 
-  prev = NULL;
-  this = md->head;
-  while (this != NULL) {
-    if (strcasecmp(e->key, this->key) == 0)
-      break;
+  if (__atomic_sub_fetch(&b->refs, 1, __ATOMIC_ACQ_REL) != 0)
+    return;
 
-    prev = this;
-    this = this->next;
-  }
+  for (size_t i = 0; i < b->entries_num; i++)
+    md_entry_free_value(b->entries + i);
+  memstats_add(b->owner,
+               -(int64_t)(sizeof(*b) + b->entries_size * sizeof(b->entries[0])),
+               -1);
+  free(b);
+} /* }}} void md_block_unref */
 
-  if (this == NULL) {
-    /* This key does not exist yet. */
-    if (md->head == NULL)
-      md->head = e;
-    else {
-      assert(prev != NULL);
-      prev->next = e;
-    }
-
-    e->next = NULL;
-  } else /* (this != NULL) */
-  {
-    if (prev == NULL)
-      md->head = e;
-    else
-      prev->next = e;
+/* Lets `copy' share the entries of `orig'. */
+static void md_block_share(meta_data_t *copy, meta_data_t *orig) /* {{{ */
+{
+  pthread_mutex_lock(&orig->lock);
+  copy->block = orig->block;
+  if (copy->block != NULL)
+    __atomic_add_fetch(&copy->block->refs, 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&orig->lock);
+} /* }}} void md_block_share */
 
-    e->next = this->next;
+/* Makes sure `md' has a block of its own with room for `extra' more entries.
+ * XXX: The lock on md must be held while calling this function! */
+static int md_block_prepare(meta_data_t *md, size_t extra) /* {{{ */
+{
+  meta_block_t *old = md->block;
+  size_t needed = ((old != NULL) ? old->entries_num : 0) + extra;
+
+  if ((old != NULL) && (__atomic_load_n(&old->refs, __ATOMIC_ACQUIRE) == 1)) {
+    if (needed <= old->entries_size)
+      return 0;
+
+    size_t size = 2 * old->entries_size;
+    meta_block_t *b =
+        realloc(old, sizeof(*b) + size * sizeof(b->entries[0]));
+    if (b == NULL) {
+      ERROR("md_block_prepare: realloc failed.");
+      return -ENOMEM;
+    }
+    memstats_add(b->owner,
+                 (int64_t)((size - b->entries_size) * sizeof(b->entries[0])),
+                 0);
+    b->entries_size = size;
+    md->block = b;
+    return 0;
   }
 
-  pthread_mutex_unlock(&md->lock);
+  size_t size = (needed > MD_BLOCK_SIZE_MIN) ? needed : MD_BLOCK_SIZE_MIN;
+  meta_block_t *b = md_block_alloc(size);
+  if (b == NULL)
+    return -ENOMEM;
 
-  if (this != NULL) {
-    this->next = NULL;
-    md_entry_free(this);
+  /* The old block is shared: copy it. */
+  for (size_t i = 0; (old != NULL) && (i < old->entries_num); i++) {
+    if (md_entry_copy(b->entries + i, old->entries + i) != 0) {
+      md_block_unref(b);
+      return -ENOMEM;
+    }
+    b->entries_num++;
   }
 
+  md_block_unref(old);
+  md->block = b;
   return 0;
-} /* }}} int md_entry_insert */
+} /* }}} int md_block_prepare */
 
 /* XXX: The lock on md must be held while calling this function! */
-static int md_entry_insert_clone(meta_data_t *md, meta_entry_t *orig) /* {{{ */
-{
-  meta_entry_t *e;
-  meta_entry_t *this;
-  meta_entry_t *prev;
-
-  /* WARNINGS :
-   *  - we do not check that md and e != NULL here. You should have done it
-   * before.
-   *  - we do not use the lock. You should have set it before.
-   */
-
-  e = md_entry_clone_contents(orig);
-
-  prev = NULL;
-  this = md->head;
-  while (this != NULL) {
-    if (strcasecmp(e->key, this->key) == 0)
-      break;
-
-    prev = this;
-    this = this->next;
-  }
-
-  if (this == NULL) {
-    /* This key does not exist yet. */
-    if (md->head == NULL)
-      md->head = e;
-    else {
-      assert(prev != NULL);
-      prev->next = e;
-    }
+static meta_entry_t *md_entry_lookup(meta_data_t *md, /* {{{ */
+                                     const char *key) {
+  if ((md == NULL) || (key == NULL) || (md->block == NULL))
+    return NULL;
+
+  for (size_t i = 0; i < md->block->entries_num; i++) {
+    meta_entry_t *e = md->block->entries + i;
+    if ((e->key == key) || (strcasecmp(key, e->key) == 0))
+      return e;
+  }
 
-    e->next = NULL;
-  } else /* (this != NULL) */
-  {
-    if (prev == NULL)
-      md->head = e;
-    else
-      prev->next = e;
+  return NULL;
+} /* }}} meta_entry_t *md_entry_lookup */
 
-    e->next = this->next;
+/* Adds `e' to `md', replacing an entry with the same key. Takes ownership of
+ * the string value of `e', even on failure.
+ * XXX: The lock on md must be held while calling this function! */
+static int md_entry_insert_locked(meta_data_t *md, /* {{{ */
+                                  meta_entry_t *e) {
+  int status = md_block_prepare(md, 1);
+  if (status != 0) {
+    md_entry_free_value(e);
+    return status;
   }
 
+  meta_entry_t *this = md_entry_lookup(md, e->key);
   if (this != NULL) {
-    this->next = NULL;
-    md_entry_free(this);
+    md_entry_free_value(this);
+    *this = *e;
+    return 0;
   }
 
+  md->block->entries[md->block->entries_num] = *e;
+  md->block->entries_num++;
   return 0;
-} /* }}} int md_entry_insert_clone */
-
-/* XXX: The lock on md must be held while calling this function! */
-static meta_entry_t *md_entry_lookup(meta_data_t *md, /* {{{ */
-                                     const char *key) {
-  meta_entry_t *e;
-
-  if ((md == NULL) || (key == NULL))
-    return NULL;
+} /* }}} int md_entry_insert_locked */
+
+static int md_entry_insert(meta_data_t *md, const char *key, /* {{{ */
+                           int type, meta_value_t value) {
+  meta_entry_t e = {
+      .key = md_key_intern(key),
+      .value = value,
+      .type = type,
+  };
+  if (e.key == NULL) {
+    md_entry_free_value(&e);
+    return -ENOMEM;
+  }
 
-  for (e = md->head; e != NULL; e = e->next)
-    if (strcasecmp(key, e->key) == 0)
-      break;
+  pthread_mutex_lock(&md->lock);
+  int status = md_entry_insert_locked(md, &e);
+  pthread_mutex_unlock(&md->lock);
 
-  return e;
-} /* }}} meta_entry_t *md_entry_lookup */
+  return status;
+} /* }}} int md_entry_insert */
 
 /*
  * Each value_list_t*, as it is going through the system, is handled by exactly
@@ -281,6 +347,10 @@ static meta_entry_t *md_entry_lookup(meta_data_t *md, /* {{{ */
  * The meta data associated with cache entries are a different story. There, we
  * need to ensure exclusive locking to prevent leaks and other funky business.
  * This is ensured by the uc_meta_data_get_*() functions.
+ *
+ * Copies made with meta_data_clone() share their entries with the original
+ * until either of them is modified, so cloning is cheap, no matter how many
+ * entries there are.
  */
 
 /*
@@ -297,6 +367,8 @@ meta_data_t *meta_data_create(void) /* {{{ */
   }
 
   pthread_mutex_init(&md->lock, /* attr = */ NULL);
+  md->owner = memstats_owner_current();
+  memstats_add(md->owner, (int64_t)sizeof(*md), 1);
 
   return md;
 } /* }}} meta_data_t *meta_data_create */
@@ -312,13 +384,26 @@ meta_data_t *meta_data_clone(meta_data_t *orig) /* {{{ */
   if (copy == NULL)
     return NULL;
 
-  pthread_mutex_lock(&orig->lock);
-  copy->head = md_entry_clone(orig->head);
-  pthread_mutex_unlock(&orig->lock);
-
+  md_block_share(copy, orig);
   return copy;
 } /* }}} meta_data_t *meta_data_clone */
 
+size_t meta_data_size(void) { return sizeof(meta_data_t); }
+
+meta_data_t *meta_data_clone_at(void *dest, meta_data_t *orig) /* {{{ */
+{
+  if ((dest == NULL) || (orig == NULL))
+    return NULL;
+
+  meta_data_t *copy = dest;
+  memset(copy, 0, sizeof(*copy));
+  pthread_mutex_init(&copy->lock, /* attr = */ NULL);
+  copy->placed = true;
+
+  md_block_share(copy, orig);
+  return copy;
+} /* }}} meta_data_t *meta_data_clone_at */
+
 int meta_data_clone_merge(meta_data_t **dest, meta_data_t *orig) /* {{{ */
 {
   if (orig == NULL)
@@ -330,8 +415,11 @@ int meta_data_clone_merge(meta_data_t **dest, meta_data_t *orig) /* {{{ */
   }
 
   pthread_mutex_lock(&orig->lock);
-  for (meta_entry_t *e = orig->head; e != NULL; e = e->next) {
-    md_entry_insert_clone((*dest), e);
+  for (size_t i = 0; (orig->block != NULL) && (i < orig->block->entries_num);
+       i++) {
+    meta_entry_t e;
+    if (md_entry_copy(&e, orig->block->entries + i) == 0)
+      md_entry_insert_locked(*dest, &e);
   }
   pthread_mutex_unlock(&orig->lock);
 
@@ -343,8 +431,11 @@ void meta_data_destroy(meta_data_t *md) /* {{{ */
   if (md == NULL)
     return;
 
-  md_entry_free(md->head);
+  md_block_unref(md->block);
   pthread_mutex_destroy(&md->lock);
+  if (md->placed)
+    return;
+  memstats_add(md->owner, -(int64_t)sizeof(*md), -1);
   free(md);
 } /* }}} void meta_data_destroy */
 
@@ -354,16 +445,10 @@ int meta_data_exists(meta_data_t *md, const char *key) /* {{{ */
     return -EINVAL;
 
   pthread_mutex_lock(&md->lock);
-
-  for (meta_entry_t *e = md->head; e != NULL; e = e->next) {
-    if (strcasecmp(key, e->key) == 0) {
-      pthread_mutex_unlock(&md->lock);
-      return 1;
-    }
-  }
-
+  int ret = (md_entry_lookup(md, key) != NULL) ? 1 : 0;
   pthread_mutex_unlock(&md->lock);
-  return 0;
+
+  return ret;
 } /* }}} int meta_data_exists */
 
 int meta_data_type(meta_data_t *md, const char *key) /* {{{ */
@@ -372,29 +457,24 @@ int meta_data_type(meta_data_t *md, const char *key) /* {{{ */
     return -EINVAL;
 
   pthread_mutex_lock(&md->lock);
-
-  for (meta_entry_t *e = md->head; e != NULL; e = e->next) {
-    if (strcasecmp(key, e->key) == 0) {
-      pthread_mutex_unlock(&md->lock);
-      return e->type;
-    }
-  }
-
+  meta_entry_t *e = md_entry_lookup(md, key);
+  int ret = (e != NULL) ? e->type : 0;
   pthread_mutex_unlock(&md->lock);
-  return 0;
+
+  return ret;
 } /* }}} int meta_data_type */
 
 int meta_data_toc(meta_data_t *md, char ***toc) /* {{{ */
 {
-  int i = 0, count = 0;
+  int count = 0;
 
   if ((md == NULL) || (toc == NULL))
     return -EINVAL;
 
   pthread_mutex_lock(&md->lock);
 
-  for (meta_entry_t *e = md->head; e != NULL; e = e->next)
-    ++count;
+  if (md->block != NULL)
+    count = (int)md->block->entries_num;
 
   if (count == 0) {
     pthread_mutex_unlock(&md->lock);
@@ -402,8 +482,8 @@ int meta_data_toc(meta_data_t *md, char ***toc) /* {{{ */
   }
 
   *toc = calloc(count, sizeof(**toc));
-  for (meta_entry_t *e = md->head; e != NULL; e = e->next)
-    (*toc)[i++] = strdup(e->key);
+  for (int i = 0; i < count; i++)
+    (*toc)[i] = strdup(md->block->entries[i].key);
 
   pthread_mutex_unlock(&md->lock);
   return count;
@@ -411,38 +491,31 @@ int meta_data_toc(meta_data_t *md, char ***toc) /* {{{ */
 
 int meta_data_delete(meta_data_t *md, const char *key) /* {{{ */
 {
-  meta_entry_t *this;
-  meta_entry_t *prev;
-
   if ((md == NULL) || (key == NULL))
     return -EINVAL;
 
   pthread_mutex_lock(&md->lock);
 
-  prev = NULL;
-  this = md->head;
-  while (this != NULL) {
-    if (strcasecmp(key, this->key) == 0)
-      break;
-
-    prev = this;
-    this = this->next;
+  if (md_entry_lookup(md, key) == NULL) {
+    pthread_mutex_unlock(&md->lock);
+    return -ENOENT;
   }
 
-  if (this == NULL) {
+  if (md_block_prepare(md, 0) != 0) {
     pthread_mutex_unlock(&md->lock);
-    return -ENOENT;
+    return -ENOMEM;
   }
 
-  if (prev == NULL)
-    md->head = this->next;
-  else
-    prev->next = this->next;
+  /* Look up again: md_block_prepare() may have copied the block. */
+  meta_entry_t *this = md_entry_lookup(md, key);
+  size_t pos = (size_t)(this - md->block->entries);
 
-  pthread_mutex_unlock(&md->lock);
+  md_entry_free_value(this);
+  memmove(this, this + 1,
+          (md->block->entries_num - (pos + 1)) * sizeof(*this));
+  md->block->entries_num--;
 
-  this->next = NULL;
-  md_entry_free(this);
+  pthread_mutex_unlock(&md->lock);
 
   return 0;
 } /* }}} int meta_data_delete */
@@ -452,92 +525,52 @@ int meta_data_delete(meta_data_t *md, const char *key) /* {{{ */
  */
 int meta_data_add_string(meta_data_t *md, /* {{{ */
                          const char *key, const char *value) {
-  meta_entry_t *e;
-
   if ((md == NULL) || (key == NULL) || (value == NULL))
     return -EINVAL;
 
-  e = md_entry_alloc(key);
-  if (e == NULL)
-    return -ENOMEM;
-
-  e->value.mv_string = md_strdup(value);
-  if (e->value.mv_string == NULL) {
+  meta_value_t v = {.mv_string = md_strdup(value)};
+  if (v.mv_string == NULL) {
     ERROR("meta_data_add_string: md_strdup failed.");
-    md_entry_free(e);
     return -ENOMEM;
   }
-  e->type = MD_TYPE_STRING;
 
-  return md_entry_insert(md, e);
+  return md_entry_insert(md, key, MD_TYPE_STRING, v);
 } /* }}} int meta_data_add_string */
 
 int meta_data_add_signed_int(meta_data_t *md, /* {{{ */
                              const char *key, int64_t value) {
-  meta_entry_t *e;
-
   if ((md == NULL) || (key == NULL))
     return -EINVAL;
 
-  e = md_entry_alloc(key);
-  if (e == NULL)
-    return -ENOMEM;
-
-  e->value.mv_signed_int = value;
-  e->type = MD_TYPE_SIGNED_INT;
-
-  return md_entry_insert(md, e);
+  return md_entry_insert(md, key, MD_TYPE_SIGNED_INT,
+                         (meta_value_t){.mv_signed_int = value});
 } /* }}} int meta_data_add_signed_int */
 
 int meta_data_add_unsigned_int(meta_data_t *md, /* {{{ */
                                const char *key, uint64_t value) {
-  meta_entry_t *e;
-
   if ((md == NULL) || (key == NULL))
     return -EINVAL;
 
-  e = md_entry_alloc(key);
-  if (e == NULL)
-    return -ENOMEM;
-
-  e->value.mv_unsigned_int = value;
-  e->type = MD_TYPE_UNSIGNED_INT;
-
-  return md_entry_insert(md, e);
+  return md_entry_insert(md, key, MD_TYPE_UNSIGNED_INT,
+                         (meta_value_t){.mv_unsigned_int = value});
 } /* }}} int meta_data_add_unsigned_int */
 
 int meta_data_add_double(meta_data_t *md, /* {{{ */
                          const char *key, double value) {
-  meta_entry_t *e;
-
   if ((md == NULL) || (key == NULL))
     return -EINVAL;
 
-  e = md_entry_alloc(key);
-  if (e == NULL)
-    return -ENOMEM;
-
-  e->value.mv_double = value;
-  e->type = MD_TYPE_DOUBLE;
-
-  return md_entry_insert(md, e);
+  return md_entry_insert(md, key, MD_TYPE_DOUBLE,
+                         (meta_value_t){.mv_double = value});
 } /* }}} int meta_data_add_double */
 
 int meta_data_add_boolean(meta_data_t *md, /* {{{ */
                           const char *key, bool value) {
-  meta_entry_t *e;
-
   if ((md == NULL) || (key == NULL))
     return -EINVAL;
 
-  e = md_entry_alloc(key);
-  if (e == NULL)
-    return -ENOMEM;
-
-  e->value.mv_boolean = value;
-  e->type = MD_TYPE_BOOLEAN;
-
-  return md_entry_insert(md, e);
+  return md_entry_insert(md, key, MD_TYPE_BOOLEAN,
+                         (meta_value_t){.mv_boolean = value});
 } /* }}} int meta_data_add_boolean */
 
 /*
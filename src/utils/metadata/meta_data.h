@@ -43,6 +43,12 @@ typedef struct meta_data_s meta_data_t;
 
 meta_data_t *meta_data_create(void);
 meta_data_t *meta_data_clone(meta_data_t *orig);
+/* Like meta_data_clone(), but places the copy at `dest', which must hold
+ * meta_data_size() bytes, suitably aligned, so it can share an allocation
+ * with its user. meta_data_destroy() releases the copy without freeing
+ * `dest'. */
+size_t meta_data_size(void);
+meta_data_t *meta_data_clone_at(void *dest, meta_data_t *orig);
 int meta_data_clone_merge(meta_data_t **dest, meta_data_t *orig);
 void meta_data_destroy(meta_data_t *md);
 
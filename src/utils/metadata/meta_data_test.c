@@ -110,8 +110,108 @@ DEF_TEST(base) {
   return 0;
 }
 
+DEF_TEST(clone) {
+  meta_data_t *orig;
+  meta_data_t *copy;
+  meta_data_t *merged = NULL;
+  char **toc = NULL;
+  char *s;
+  int64_t si;
+
+  CHECK_NOT_NULL(orig = meta_data_create());
+  CHECK_ZERO(meta_data_add_string(orig, "string", "foobar"));
+  CHECK_ZERO(meta_data_add_signed_int(orig, "signed_int", -1));
+  CHECK_ZERO(meta_data_add_boolean(orig, "boolean", true));
+
+  CHECK_NOT_NULL(copy = meta_data_clone(orig));
+
+  /* modifying the copy leaves the original alone */
+  CHECK_ZERO(meta_data_add_string(copy, "string", "barqux"));
+  CHECK_ZERO(meta_data_add_double(copy, "double", 47.11));
+
+  CHECK_ZERO(meta_data_get_string(orig, "string", &s));
+  EXPECT_EQ_STR("foobar", s);
+  sfree(s);
+  EXPECT_EQ_INT(0, meta_data_exists(orig, "double"));
+
+  CHECK_ZERO(meta_data_get_string(copy, "string", &s));
+  EXPECT_EQ_STR("barqux", s);
+  sfree(s);
+
+  /* ... and vice versa */
+  CHECK_ZERO(meta_data_delete(orig, "signed_int"));
+  CHECK_ZERO(meta_data_get_signed_int(copy, "signed_int", &si));
+  EXPECT_EQ_INT(-1, (int)si);
+
+  /* the order of keys is preserved */
+  EXPECT_EQ_INT(4, meta_data_toc(copy, &toc));
+  EXPECT_EQ_STR("string", toc[0]);
+  EXPECT_EQ_STR("signed_int", toc[1]);
+  EXPECT_EQ_STR("boolean", toc[2]);
+  EXPECT_EQ_STR("double", toc[3]);
+  for (size_t i = 0; i < 4; i++)
+    sfree(toc[i]);
+  sfree(toc);
+
+  /* a clone outlives its original */
+  meta_data_destroy(orig);
+  CHECK_ZERO(meta_data_get_string(copy, "String", &s));
+  EXPECT_EQ_STR("barqux", s);
+  sfree(s);
+
+  /* merging into an existing object copies and replaces keys */
+  CHECK_NOT_NULL(merged = meta_data_create());
+  CHECK_ZERO(meta_data_add_signed_int(merged, "signed_int", 42));
+  CHECK_ZERO(meta_data_add_signed_int(merged, "other", 23));
+  CHECK_ZERO(meta_data_clone_merge(&merged, copy));
+  meta_data_destroy(copy);
+
+  CHECK_ZERO(meta_data_get_signed_int(merged, "signed_int", &si));
+  EXPECT_EQ_INT(-1, (int)si);
+  CHECK_ZERO(meta_data_get_signed_int(merged, "other", &si));
+  EXPECT_EQ_INT(23, (int)si);
+  CHECK_ZERO(meta_data_get_string(merged, "string", &s));
+  EXPECT_EQ_STR("barqux", s);
+  sfree(s);
+
+  meta_data_destroy(merged);
+  return 0;
+}
+
+DEF_TEST(clone_at) {
+  meta_data_t *orig;
+  meta_data_t *copy;
+  char *s;
+
+  CHECK_NOT_NULL(orig = meta_data_create());
+  CHECK_ZERO(meta_data_add_string(orig, "string", "foobar"));
+
+  void *buffer = calloc(1, meta_data_size());
+  CHECK_NOT_NULL(buffer);
+  CHECK_NOT_NULL(copy = meta_data_clone_at(buffer, orig));
+  OK(copy == buffer);
+
+  CHECK_ZERO(meta_data_add_string(copy, "string", "barqux"));
+  CHECK_ZERO(meta_data_get_string(orig, "string", &s));
+  EXPECT_EQ_STR("foobar", s);
+  sfree(s);
+
+  meta_data_destroy(orig);
+  CHECK_ZERO(meta_data_get_string(copy, "string", &s));
+  EXPECT_EQ_STR("barqux", s);
+  sfree(s);
+
+  /* releases the copy, but leaves the buffer to the caller */
+  meta_data_destroy(copy);
+  free(buffer);
+
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(base);
+  RUN_TEST(clone);
+  RUN_TEST(clone_at);
 
   END_TEST;
 }
@@ -56,6 +56,9 @@ struct oauth_s {
 
   EVP_PKEY *key;
 
+  /* token and valid_until are protected by lock, so that the token can be
+   * renewed by one thread while others use it. */
+  pthread_mutex_t lock;
   char *token;
   cdtime_t valid_until;
 };
@@ -448,6 +451,7 @@ static oauth_t *oauth_create(char const *url, char const *iss,
   if (auth == NULL)
     return NULL;
   memset(auth, 0, sizeof(*auth));
+  pthread_mutex_init(&auth->lock, /* attr = */ NULL);
 
   auth->url = strdup(url);
   auth->iss = strdup(iss);
@@ -611,12 +615,14 @@ void oauth_destroy(oauth_t *auth) /* {{{ */
   sfree(auth->iss);
   sfree(auth->scope);
   sfree(auth->aud);
+  sfree(auth->token);
 
   if (auth->key != NULL) {
     EVP_PKEY_free(auth->key);
     auth->key = NULL;
   }
 
+  pthread_mutex_destroy(&auth->lock);
   sfree(auth);
 } /* }}} void oauth_destroy */
 
@@ -628,11 +634,15 @@ int oauth_access_token(oauth_t *auth, char *buffer,
   if (auth == NULL)
     return EINVAL;
 
+  pthread_mutex_lock(&auth->lock);
   status = renew_token(auth);
-  if (status != 0)
+  if (status != 0) {
+    pthread_mutex_unlock(&auth->lock);
     return status;
+  }
   assert(auth->token != NULL);
 
   sstrncpy(buffer, auth->token, buffer_size);
+  pthread_mutex_unlock(&auth->lock);
   return 0;
 } /* }}} int oauth_access_token */
@@ -139,6 +139,10 @@ typedef struct ovs_json_reader_s ovs_json_reader_t;
 struct ovs_result_cb_s {
   sem_t sync;
   ovs_db_result_cb_t call;
+  /* the reply is the one of "monitor_cond_since", see ovs_db_result_cb() */
+  bool cond_since;
+  /* the server replied with an error */
+  bool failed;
 };
 typedef struct ovs_result_cb_s ovs_result_cb_t;
 
@@ -475,15 +479,18 @@ static int ovs_db_table_update_cb(ovs_db_t *pdb, yajl_val jnode) {
     return -1;
   }
 
-  /* check array length: [<json-value>, <table-updates>] */
+  /* check array length: [<json-value>, <table-updates>] or, for "update3",
+   * [<json-value>, <last-txn-id>, <table-updates2>] */
   if ((YAJL_GET_ARRAY(jparams) == NULL) ||
-      (YAJL_GET_ARRAY(jparams)->len != 2)) {
+      (YAJL_GET_ARRAY(jparams)->len != 2 &&
+       YAJL_GET_ARRAY(jparams)->len != 3)) {
     OVS_ERROR("invalid OVS DB request received");
     return -1;
   }
 
   jvalue = YAJL_GET_ARRAY(jparams)->values[0];
-  jtable_updates = YAJL_GET_ARRAY(jparams)->values[1];
+  jtable_updates =
+      YAJL_GET_ARRAY(jparams)->values[YAJL_GET_ARRAY(jparams)->len - 1];
   if ((!YAJL_IS_OBJECT(jtable_updates)) || (!YAJL_IS_STRING(jvalue))) {
     OVS_ERROR("invalid OVS DB request id or table update received");
     return -1;
@@ -529,7 +536,16 @@ static int ovs_db_result_cb(ovs_db_t *pdb, yajl_val jnode) {
   /* try to find registered callback */
   pthread_mutex_lock(&pdb->mutex);
   cb = ovs_db_table_callback_get(pdb, jid);
-  if (cb != NULL && cb->result.call != NULL) {
+  if (cb != NULL && cb->result.cond_since) {
+    /* "monitor_cond_since" replies with
+     * [<found>, <last-txn-id>, <table-updates2>] */
+    if (!YAJL_IS_NULL(jerror) || !YAJL_IS_ARRAY(jresult) ||
+        YAJL_GET_ARRAY(jresult)->len != 3)
+      cb->result.failed = true;
+    else if (cb->result.call != NULL)
+      cb->result.call(YAJL_GET_ARRAY(jresult)->values[2], jerror);
+    sem_post(&cb->result.sync);
+  } else if (cb != NULL && cb->result.call != NULL) {
     /* call registered callback */
     cb->result.call(jresult, jerror);
     /* unlock owner of the reply */
@@ -559,7 +575,7 @@ static int ovs_db_json_data_process(ovs_db_t *pdb, const char *data,
   if ((sjson = calloc(1, len + 1)) == NULL)
     return -1;
 
-  sstrncpy(sjson, data, len + 1);
+  memcpy(sjson, data, len);
   OVS_DEBUG("[len=%" PRIsz "] %s", len, sjson);
 
   /* parse json data */
@@ -581,7 +597,8 @@ static int ovs_db_json_data_process(ovs_db_t *pdb, const char *data,
       /* echo request from the server */
       if (ovs_db_table_echo_cb(pdb, jnode) < 0)
         OVS_ERROR("handle echo request failed");
-    } else if (strcmp("update", method) == 0) {
+    } else if (strcmp("update", method) == 0 ||
+               strcmp("update3", method) == 0) {
       /* update notification */
       if (ovs_db_table_update_cb(pdb, jnode) < 0)
         OVS_ERROR("handle update notification failed");
@@ -1077,8 +1094,12 @@ failure:
   return NULL;
 }
 
-int ovs_db_send_request(ovs_db_t *pdb, const char *method, const char *params,
-                        ovs_db_result_cb_t cb) {
+/* Sends a request like ovs_db_send_request(). With `cond_since', the reply is
+ * the one of "monitor_cond_since" and the request waits for it even without a
+ * result callback. `failed' is set if the server replied with an error. */
+static int ovs_db_send_request_ex(ovs_db_t *pdb, const char *method,
+                                  const char *params, ovs_db_result_cb_t cb,
+                                  bool cond_since, bool *failed) {
   int ret = 0;
   yajl_gen_status yajl_gen_ret;
   yajl_val jparams;
@@ -1100,7 +1121,7 @@ int ovs_db_send_request(ovs_db_t *pdb, const char *method, const char *params,
   /* try to parse params */
   if ((jparams = yajl_tree_parse(params, NULL, 0)) == NULL) {
     OVS_ERROR("params is not a JSON string");
-    yajl_gen_clear(jgen);
+    yajl_gen_free(jgen);
     return -1;
   }
 
@@ -1123,7 +1144,7 @@ int ovs_db_send_request(ovs_db_t *pdb, const char *method, const char *params,
 
   OVS_YAJL_CALL(yajl_gen_map_close, jgen);
 
-  if (cb) {
+  if (cb || cond_since) {
     /* register result callback */
     if ((new_cb = calloc(1, sizeof(*new_cb))) == NULL)
       goto yajl_gen_failure;
@@ -1131,6 +1152,7 @@ int ovs_db_send_request(ovs_db_t *pdb, const char *method, const char *params,
     /* add new callback to front */
     sem_init(&new_cb->result.sync, 0, 0);
     new_cb->result.call = cb;
+    new_cb->result.cond_since = cond_since;
     new_cb->uid = uid;
     ovs_db_callback_add(pdb, new_cb);
   }
@@ -1139,7 +1161,7 @@ int ovs_db_send_request(ovs_db_t *pdb, const char *method, const char *params,
   OVS_YAJL_CALL(yajl_gen_get_buf, jgen, (const unsigned char **)&req, &req_len);
   OVS_DEBUG("%s", req);
   if (!ovs_db_data_send(pdb, req, req_len)) {
-    if (cb) {
+    if (new_cb) {
       /* wait for result */
       clock_gettime(CLOCK_REALTIME, &ts);
       ts.tv_sec += OVS_DB_SEND_REQ_TIMEOUT;
@@ -1147,6 +1169,8 @@ int ovs_db_send_request(ovs_db_t *pdb, const char *method, const char *params,
         OVS_ERROR("%s() no replay received within %d sec", __FUNCTION__,
                   OVS_DB_SEND_REQ_TIMEOUT);
         ret = (-1);
+      } else if (failed != NULL) {
+        *failed = new_cb->result.failed;
       }
     }
   } else {
@@ -1162,49 +1186,32 @@ yajl_gen_failure:
   }
 
   /* release memory */
-  yajl_gen_clear(jgen);
+  yajl_gen_free(jgen);
   return (yajl_gen_ret != yajl_gen_status_ok) ? (-1) : ret;
 }
 
-int ovs_db_table_cb_register(ovs_db_t *pdb, const char *tb_name,
-                             const char **tb_column,
-                             ovs_db_table_cb_t update_cb,
-                             ovs_db_result_cb_t result_cb, unsigned int flags) {
-  yajl_gen jgen;
-  yajl_gen_status yajl_gen_ret;
-  ovs_callback_t *new_cb = NULL;
-  char uid_str[OVS_UID_STR_SIZE];
-  char *params;
-  size_t params_len;
-  int ovs_db_ret = 0;
-
-  /* sanity check */
-  if (pdb == NULL || tb_name == NULL || update_cb == NULL)
-    return -1;
-
-  /* allocate new update callback */
-  if ((new_cb = calloc(1, sizeof(*new_cb))) == NULL)
-    return -1;
-
-  /* init YAJL generator */
-  if ((jgen = yajl_gen_alloc(NULL)) == NULL) {
-    sfree(new_cb);
-    return -1;
-  }
+int ovs_db_send_request(ovs_db_t *pdb, const char *method, const char *params,
+                        ovs_db_result_cb_t cb) {
+  return ovs_db_send_request_ex(pdb, method, params, cb, false, NULL);
+}
 
-  /* add new callback to front */
-  new_cb->table.call = update_cb;
-  new_cb->uid = ovs_uid_generate();
-  ovs_db_callback_add(pdb, new_cb);
+/* Generates the params of a "monitor" request or, with `cond_since', of a
+ * "monitor_cond_since" request. Both take the same <monitor-requests>, the
+ * latter adds the id of the last transaction seen. */
+static yajl_gen_status ovs_db_monitor_params_gen(yajl_gen jgen,
+                                                 const char *tb_name,
+                                                 const char **tb_column,
+                                                 const char *uid_str,
+                                                 unsigned int flags,
+                                                 bool cond_since) {
+  yajl_gen_status yajl_gen_ret;
 
-  /* make update notification request
-   * [<db-name>, <json-value>, <monitor-requests>] */
+  /* [<db-name>, <json-value>, <monitor-requests>(, <last-txn-id>)] */
   OVS_YAJL_CALL(yajl_gen_array_open, jgen);
   {
     OVS_YAJL_CALL(ovs_yajl_gen_tstring, jgen, OVS_DB_DEFAULT_DB_NAME);
 
     /* uid string <json-value> */
-    ssnprintf(uid_str, sizeof(uid_str), "%" PRIX64, new_cb->uid);
     OVS_YAJL_CALL(ovs_yajl_gen_tstring, jgen, uid_str);
 
     /* <monitor-requests> */
@@ -1250,9 +1257,80 @@ int ovs_db_table_cb_register(ovs_db_t *pdb, const char *tb_name,
       OVS_YAJL_CALL(yajl_gen_array_close, jgen);
     }
     OVS_YAJL_CALL(yajl_gen_map_close, jgen);
+
+    /* all updates are requested, starting from an empty database */
+    if (cond_since)
+      OVS_YAJL_CALL(ovs_yajl_gen_tstring, jgen,
+                    "00000000-0000-0000-0000-000000000000");
   }
   OVS_YAJL_CALL(yajl_gen_array_close, jgen);
 
+yajl_gen_failure:
+  return yajl_gen_ret;
+}
+
+int ovs_db_table_cb_register(ovs_db_t *pdb, const char *tb_name,
+                             const char **tb_column,
+                             ovs_db_table_cb_t update_cb,
+                             ovs_db_result_cb_t result_cb, unsigned int flags) {
+  yajl_gen jgen;
+  yajl_gen_status yajl_gen_ret;
+  ovs_callback_t *new_cb = NULL;
+  char uid_str[OVS_UID_STR_SIZE];
+  char *params;
+  size_t params_len;
+  int ovs_db_ret = 0;
+
+  /* sanity check */
+  if (pdb == NULL || tb_name == NULL || update_cb == NULL)
+    return -1;
+
+  /* allocate new update callback */
+  if ((new_cb = calloc(1, sizeof(*new_cb))) == NULL)
+    return -1;
+
+  /* init YAJL generator */
+  if ((jgen = yajl_gen_alloc(NULL)) == NULL) {
+    sfree(new_cb);
+    return -1;
+  }
+
+  /* add new callback to front */
+  new_cb->table.call = update_cb;
+  new_cb->uid = ovs_uid_generate();
+  ovs_db_callback_add(pdb, new_cb);
+
+  /* uid string <json-value> */
+  ssnprintf(uid_str, sizeof(uid_str), "%" PRIX64, new_cb->uid);
+
+  bool cond_since = (flags & OVS_DB_TABLE_CB_FLAG_COND_SINCE) != 0;
+  if (cond_since) {
+    /* only the changed columns of modified rows are sent */
+    bool failed = false;
+    OVS_YAJL_CALL(ovs_db_monitor_params_gen, jgen, tb_name, tb_column, uid_str,
+                  flags, true);
+    OVS_YAJL_CALL(yajl_gen_get_buf, jgen, (const unsigned char **)&params,
+                  &params_len);
+    if (ovs_db_send_request_ex(pdb, "monitor_cond_since", params, result_cb,
+                               true, &failed) < 0) {
+      OVS_ERROR("Failed to subscribe to \"%s\" table", tb_name);
+      ovs_db_ret = (-1);
+      goto yajl_gen_failure;
+    }
+    if (!failed)
+      goto yajl_gen_failure;
+
+    /* older servers do not know "monitor_cond_since" */
+    OVS_DEBUG("\"monitor_cond_since\" failed, using \"monitor\"");
+    yajl_gen_free(jgen);
+    if ((jgen = yajl_gen_alloc(NULL)) == NULL)
+      return -1;
+  }
+
+  /* make update notification request */
+  OVS_YAJL_CALL(ovs_db_monitor_params_gen, jgen, tb_name, tb_column, uid_str,
+                flags, false);
+
   /* make a request to subscribe to given table */
   OVS_YAJL_CALL(yajl_gen_get_buf, jgen, (const unsigned char **)&params,
                 &params_len);
@@ -1263,7 +1341,7 @@ int ovs_db_table_cb_register(ovs_db_t *pdb, const char *tb_name,
 
 yajl_gen_failure:
   /* release memory */
-  yajl_gen_clear(jgen);
+  yajl_gen_free(jgen);
   return ovs_db_ret;
 }
 
@@ -161,6 +161,7 @@ int ovs_db_send_request(ovs_db_t *pdb, const char *method, const char *params,
 #define OVS_DB_TABLE_CB_FLAG_DELETE 0x04U
 #define OVS_DB_TABLE_CB_FLAG_MODIFY 0x08U
 #define OVS_DB_TABLE_CB_FLAG_ALL 0x0FU
+#define OVS_DB_TABLE_CB_FLAG_COND_SINCE 0x10U
 
 /*
  * NAME
@@ -188,6 +189,16 @@ int ovs_db_send_request(ovs_db_t *pdb, const char *method, const char *params,
  *                   OVS_DB_TABLE_CB_FLAG_DELETE  Receive table remove events.
  *                   OVS_DB_TABLE_CB_FLAG_MODIFY  Receive table update events.
  *                   OVS_DB_TABLE_CB_FLAG_ALL     Receive all events.
+ *                   OVS_DB_TABLE_CB_FLAG_COND_SINCE
+ *                                   Subscribe with "monitor_cond_since".
+ *                                   The callbacks then receive
+ *                                   <table-updates2>: row updates are keyed
+ *                                   by "initial", "insert", "modify" or
+ *                                   "delete", and "modify" only carries the
+ *                                   changed columns and, for maps, the
+ *                                   changed pairs. If the server does not
+ *                                   know the method, "monitor" is used and
+ *                                   the callbacks receive <table-updates>.
  *
  * RETURN VALUE
  *   Zero upon success or non-zero if an error occurred.
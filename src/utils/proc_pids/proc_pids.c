@@ -31,8 +31,28 @@
 #include "utils/common/common.h"
 #include "utils/proc_pids/proc_pids.h"
 
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#include <sys/socket.h>
+
 #define UTIL_NAME "utils_proc_pids"
 
+/* Requested receive buffer size of the proc connector socket. Events are only
+ * drained once per read interval, so there must be room for bursts. */
+#define PROC_PIDS_MONITOR_RCVBUF (1024 * 1024)
+
+struct proc_pids_monitor_s {
+  char *procfs_path;
+  int nl_sock;
+  /* false until the tracked lists have been filled by a full /proc scan and
+   * after events have been lost */
+  bool synced;
+  /* PIDs per process name, indexed like the proc_pids array */
+  pids_list_t *tracked;
+  size_t tracked_num;
+};
+
 void pids_list_free(pids_list_t *list) {
   assert(list);
 
@@ -141,23 +161,27 @@ int pids_list_contains_pid(pids_list_t *list, const pid_t pid) {
  *   On success, the number of read bytes (includes stripped \n).
  *   -1 on file open error
  */
-static int read_proc_name(const char *procfs_path,
-                          const struct dirent *pid_entry, char *name,
-                          const size_t out_size) {
-  assert(pid_entry);
+static int read_pid_name(const char *procfs_path, const char *pid_dir,
+                         char *name, const size_t out_size) {
+  assert(pid_dir);
   assert(name);
   assert(out_size);
   memset(name, 0, out_size);
 
   const char *comm_file_name = "comm";
 
-  char *path = ssnprintf_alloc("%s/%s/%s", procfs_path, pid_entry->d_name,
-                               comm_file_name);
+  char *path =
+      ssnprintf_alloc("%s/%s/%s", procfs_path, pid_dir, comm_file_name);
   if (path == NULL)
     return -1;
   FILE *f = fopen(path, "r");
   if (f == NULL) {
-    ERROR(UTIL_NAME ": Failed to open comm file, error: %d\n", errno);
+    /* The process may have exited in the meantime. */
+    if (errno == ENOENT) {
+      DEBUG(UTIL_NAME ": Process %s is gone.", pid_dir);
+    } else {
+      ERROR(UTIL_NAME ": Failed to open comm file, error: %d\n", errno);
+    }
     sfree(path);
     return -1;
   }
@@ -174,6 +198,13 @@ static int read_proc_name(const char *procfs_path,
   return read_length;
 }
 
+static int read_proc_name(const char *procfs_path,
+                          const struct dirent *pid_entry, char *name,
+                          const size_t out_size) {
+  assert(pid_entry);
+  return read_pid_name(procfs_path, pid_entry->d_name, name, out_size);
+}
+
 /*
  * NAME
  *   get_pid_number
@@ -347,6 +378,305 @@ int pids_list_diff(proc_pids_t *proc, pids_list_t *added,
   return 0;
 }
 
+static void pids_list_remove_pid(pids_list_t *list, const pid_t pid) {
+  for (size_t i = 0; i < list->size; i++) {
+    if (list->pids[i] != pid)
+      continue;
+    list->pids[i] = list->pids[list->size - 1];
+    list->size--;
+    return;
+  }
+}
+
+/* Moves pid to the lists of all process names matching comm. */
+static void monitor_assign(proc_pids_monitor_t *mon, proc_pids_t **proc_pids,
+                           const pid_t pid, const char *comm) {
+  for (size_t i = 0; i < mon->tracked_num; i++) {
+    pids_list_remove_pid(&mon->tracked[i], pid);
+    if ((comm != NULL) && (0 == strncmp(comm, proc_pids[i]->process_name,
+                                        sizeof(proc_comm_t))))
+      pids_list_add_pid(&mon->tracked[i], pid);
+  }
+}
+
+static void monitor_assign_from_procfs(proc_pids_monitor_t *mon,
+                                       proc_pids_t **proc_pids,
+                                       const pid_t pid) {
+  char pid_dir[32];
+  proc_comm_t comm;
+
+  ssnprintf(pid_dir, sizeof(pid_dir), "%ld", (long)pid);
+  /* The process may be gone already, its exit event follows. */
+  if (read_pid_name(mon->procfs_path, pid_dir, comm, sizeof(comm)) <= 0) {
+    monitor_assign(mon, proc_pids, pid, NULL);
+    return;
+  }
+  monitor_assign(mon, proc_pids, pid, comm);
+}
+
+/*
+ * NAME
+ *   monitor_apply_event
+ *
+ * DESCRIPTION
+ *   Updates the tracked PID lists with one proc connector event. Only
+ *   processes (thread group leaders) are tracked, like in /proc. All updates
+ *   are idempotent, so events racing with a full scan are harmless.
+ */
+static void monitor_apply_event(proc_pids_monitor_t *mon,
+                                proc_pids_t **proc_pids,
+                                const struct proc_event *ev) {
+  switch (ev->what) {
+  case PROC_EVENT_FORK: {
+    pid_t parent = ev->event_data.fork.parent_tgid;
+    pid_t child = ev->event_data.fork.child_tgid;
+
+    if (ev->event_data.fork.child_pid != child)
+      break; /* new thread */
+
+    /* The child inherits the name of the forking thread. For the main thread
+     * that is the name the parent is tracked with. */
+    if (ev->event_data.fork.parent_pid != parent) {
+      monitor_assign_from_procfs(mon, proc_pids, child);
+      break;
+    }
+    for (size_t i = 0; i < mon->tracked_num; i++)
+      if (pids_list_contains_pid(&mon->tracked[i], parent) &&
+          !pids_list_contains_pid(&mon->tracked[i], child))
+        pids_list_add_pid(&mon->tracked[i], child);
+    break;
+  }
+  case PROC_EVENT_EXEC:
+    monitor_assign_from_procfs(mon, proc_pids,
+                               ev->event_data.exec.process_tgid);
+    break;
+  case PROC_EVENT_COMM: {
+    if (ev->event_data.comm.process_pid != ev->event_data.comm.process_tgid)
+      break; /* thread renamed */
+
+    proc_comm_t comm;
+    sstrncpy(comm, ev->event_data.comm.comm, sizeof(comm));
+    monitor_assign(mon, proc_pids, ev->event_data.comm.process_tgid, comm);
+    break;
+  }
+  case PROC_EVENT_EXIT:
+    if (ev->event_data.exit.process_pid != ev->event_data.exit.process_tgid)
+      break; /* thread exited */
+    monitor_assign(mon, proc_pids, ev->event_data.exit.process_tgid, NULL);
+    break;
+  default:
+    break;
+  }
+}
+
+/*
+ * NAME
+ *   monitor_drain
+ *
+ * DESCRIPTION
+ *   Reads all queued proc connector events without blocking. If `proc_pids'
+ *   is NULL the events are discarded.
+ *
+ * RETURN VALUE
+ *   0 on success. ENOBUFS if events have been lost, another errno otherwise.
+ */
+static int monitor_drain(proc_pids_monitor_t *mon, proc_pids_t **proc_pids) {
+  char buffer[4096] __attribute__((aligned(NLMSG_ALIGNTO)));
+  int ret = 0;
+
+  while (42) {
+    ssize_t status = recv(mon->nl_sock, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (status < 0) {
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        return ret;
+      if (errno == EINTR)
+        continue;
+      if (errno == ENOBUFS) {
+        ret = ENOBUFS;
+        continue;
+      }
+      ret = errno;
+      ERROR(UTIL_NAME ": recv on proc connector failed: %s", STRERROR(ret));
+      return ret;
+    }
+
+    int len = (int)status;
+    for (struct nlmsghdr *nlh = (struct nlmsghdr *)buffer; NLMSG_OK(nlh, len);
+         nlh = NLMSG_NEXT(nlh, len)) {
+      if (nlh->nlmsg_type == NLMSG_NOOP)
+        continue;
+      if ((nlh->nlmsg_type == NLMSG_ERROR) ||
+          (nlh->nlmsg_type == NLMSG_OVERRUN)) {
+        ret = ENOBUFS;
+        continue;
+      }
+
+      struct cn_msg *cn = NLMSG_DATA(nlh);
+      if ((cn->id.idx != CN_IDX_PROC) || (cn->id.val != CN_VAL_PROC) ||
+          (cn->len < sizeof(struct proc_event)))
+        continue;
+
+      if (proc_pids != NULL)
+        monitor_apply_event(mon, proc_pids, (struct proc_event *)cn->data);
+    }
+  }
+}
+
+static int monitor_subscribe(int nl_sock, bool enable) {
+  struct __attribute__((aligned(NLMSG_ALIGNTO))) {
+    struct nlmsghdr nl_hdr;
+    struct __attribute__((__packed__)) {
+      struct cn_msg cn_msg;
+      enum proc_cn_mcast_op cn_mcast;
+    };
+  } nlcn_msg;
+
+  memset(&nlcn_msg, 0, sizeof(nlcn_msg));
+  nlcn_msg.nl_hdr.nlmsg_len = sizeof(nlcn_msg);
+  nlcn_msg.nl_hdr.nlmsg_pid = getpid();
+  nlcn_msg.nl_hdr.nlmsg_type = NLMSG_DONE;
+
+  nlcn_msg.cn_msg.id.idx = CN_IDX_PROC;
+  nlcn_msg.cn_msg.id.val = CN_VAL_PROC;
+  nlcn_msg.cn_msg.len = sizeof(enum proc_cn_mcast_op);
+
+  nlcn_msg.cn_mcast = enable ? PROC_CN_MCAST_LISTEN : PROC_CN_MCAST_IGNORE;
+
+  if (send(nl_sock, &nlcn_msg, sizeof(nlcn_msg), 0) < 0)
+    return errno;
+  return 0;
+}
+
+proc_pids_monitor_t *proc_pids_monitor_create(const char *procfs_path) {
+  assert(procfs_path);
+
+  proc_pids_monitor_t *mon = calloc(1, sizeof(*mon));
+  if (mon == NULL)
+    return NULL;
+  mon->nl_sock = -1;
+
+  mon->procfs_path = strdup(procfs_path);
+  if (mon->procfs_path == NULL)
+    goto monitor_create_error;
+
+  mon->nl_sock = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC,
+                        NETLINK_CONNECTOR);
+  if (mon->nl_sock < 0) {
+    INFO(UTIL_NAME ": Opening proc connector socket failed: %s", STRERRNO);
+    goto monitor_create_error;
+  }
+
+  int rcvbuf = PROC_PIDS_MONITOR_RCVBUF;
+  if (setsockopt(mon->nl_sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf,
+                 sizeof(rcvbuf)) != 0) {
+    DEBUG(UTIL_NAME ": setsockopt(SO_RCVBUF) failed: %s", STRERRNO);
+  }
+
+  struct sockaddr_nl sa_nl = {
+      .nl_family = AF_NETLINK,
+      .nl_groups = CN_IDX_PROC,
+      .nl_pid = 0,
+  };
+  if (bind(mon->nl_sock, (struct sockaddr *)&sa_nl, sizeof(sa_nl)) != 0) {
+    INFO(UTIL_NAME ": Binding proc connector socket failed: %s", STRERRNO);
+    goto monitor_create_error;
+  }
+
+  int status = monitor_subscribe(mon->nl_sock, true);
+  if (status != 0) {
+    INFO(UTIL_NAME ": Subscribing to proc events failed: %s",
+         STRERROR(status));
+    goto monitor_create_error;
+  }
+
+  return mon;
+
+monitor_create_error:
+  proc_pids_monitor_destroy(mon);
+  return NULL;
+}
+
+void proc_pids_monitor_destroy(proc_pids_monitor_t *mon) {
+  if (mon == NULL)
+    return;
+
+  if (mon->nl_sock >= 0) {
+    monitor_subscribe(mon->nl_sock, false);
+    close(mon->nl_sock);
+  }
+
+  for (size_t i = 0; i < mon->tracked_num; i++)
+    pids_list_clear(&mon->tracked[i]);
+  sfree(mon->tracked);
+  sfree(mon->procfs_path);
+  sfree(mon);
+}
+
+int proc_pids_monitor_update(proc_pids_monitor_t *mon, proc_pids_t **proc_pids,
+                             size_t proc_pids_num) {
+  assert(mon);
+  assert(proc_pids);
+
+  if (mon->tracked_num != proc_pids_num) {
+    for (size_t i = 0; i < mon->tracked_num; i++)
+      pids_list_clear(&mon->tracked[i]);
+    sfree(mon->tracked);
+    mon->tracked_num = 0;
+    mon->synced = false;
+
+    mon->tracked = calloc(proc_pids_num, sizeof(*mon->tracked));
+    if (mon->tracked == NULL) {
+      ERROR(UTIL_NAME ": Alloc error\n");
+      return -1;
+    }
+    mon->tracked_num = proc_pids_num;
+  }
+
+  if (mon->synced && (monitor_drain(mon, proc_pids) != 0)) {
+    WARNING(UTIL_NAME ": Process events have been lost, rescanning %s.",
+            mon->procfs_path);
+    mon->synced = false;
+  }
+
+  if (!mon->synced) {
+    /* Everything queued so far is covered by the full scan. */
+    monitor_drain(mon, NULL);
+
+    if (proc_pids_update(mon->procfs_path, proc_pids, proc_pids_num) != 0)
+      return -1;
+
+    for (size_t i = 0; i < proc_pids_num; i++) {
+      mon->tracked[i].size = 0;
+      if (pids_list_add_list(&mon->tracked[i], proc_pids[i]->curr) != 0)
+        return -1;
+    }
+    mon->synced = true;
+    return 0;
+  }
+
+  swap_proc_pids(proc_pids, proc_pids_num);
+
+  for (size_t i = 0; i < proc_pids_num; i++) {
+    if (NULL == proc_pids[i]->curr)
+      proc_pids[i]->curr = calloc(1, sizeof(*(proc_pids[i]->curr)));
+
+    if (NULL == proc_pids[i]->curr) {
+      ERROR(UTIL_NAME ": Alloc error\n");
+      goto update_error;
+    }
+
+    proc_pids[i]->curr->size = 0;
+    if (0 != pids_list_add_list(proc_pids[i]->curr, &mon->tracked[i]))
+      goto update_error;
+  }
+
+  return 0;
+
+update_error:
+  swap_proc_pids(proc_pids, proc_pids_num);
+  return -1;
+}
+
 int proc_pids_free(proc_pids_t *proc_pids[], size_t proc_pids_num) {
   for (size_t i = 0; i < proc_pids_num; i++) {
     if (NULL != proc_pids[i]->curr)
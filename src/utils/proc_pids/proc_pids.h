@@ -58,6 +58,9 @@ typedef struct proc_pids_s {
   pids_list_t *curr;
 } proc_pids_t;
 
+/* Event driven alternative to proc_pids_update, see proc_pids_monitor_create */
+typedef struct proc_pids_monitor_s proc_pids_monitor_t;
+
 /*
  * NAME
  *   pids_list_free
@@ -228,4 +231,55 @@ int proc_pids_update(const char *procfs_path, proc_pids_t *proc_pids[],
  */
 int proc_pids_free(proc_pids_t *proc_pids[], size_t proc_pids_num);
 
+/*
+ * NAME
+ *   proc_pids_monitor_create
+ *
+ * DESCRIPTION
+ *   Subscribes to process fork/exec/comm/exit events of the netlink proc
+ *   connector. Requires CAP_NET_ADMIN.
+ *
+ * PARAMETERS
+ *   `procfs_path'     Path to systems proc directory (e.g. /proc)
+ *
+ * RETURN VALUE
+ *   New monitor on success. NULL if the proc connector is not available, in
+ *   which case callers should fall back to proc_pids_update.
+ */
+proc_pids_monitor_t *proc_pids_monitor_create(const char *procfs_path);
+
+/*
+ * NAME
+ *   proc_pids_monitor_update
+ *
+ * DESCRIPTION
+ *   Same as proc_pids_update, but keeps the PIDs matching the process names
+ *   up to date from the queued process events instead of rescanning all
+ *   processes. A full scan is only done on the first call, when the number
+ *   of proc_pids changes and after events have been lost.
+ *
+ * PARAMETERS
+ *   `mon'             Monitor returned by proc_pids_monitor_create.
+ *   `proc_pids'       Array of proc_pids pointers to be updated. Must be the
+ *                     same array (same names in the same order) each time.
+ *   `proc_pids_num'   proc_pids element count
+ *
+ * RETURN VALUE
+ *   0 on success. -1 on error.
+ */
+int proc_pids_monitor_update(proc_pids_monitor_t *mon, proc_pids_t *proc_pids[],
+                             size_t proc_pids_num);
+
+/*
+ * NAME
+ *   proc_pids_monitor_destroy
+ *
+ * DESCRIPTION
+ *   Unsubscribes from process events and releases the monitor.
+ *
+ * PARAMETERS
+ *   `mon'             Monitor returned by proc_pids_monitor_create.
+ */
+void proc_pids_monitor_destroy(proc_pids_monitor_t *mon);
+
 #endif /* UTILS_PROC_PIDS_PROC_PIDS_H */
@@ -489,6 +489,106 @@ DEF_TEST(pids_list_diff__one_removed) {
   return 0;
 }
 
+static proc_pids_monitor_t *stub_monitor_create(size_t tracked_num) {
+  proc_pids_monitor_t *mon = calloc(1, sizeof(*mon));
+  mon->nl_sock = -1;
+  mon->procfs_path = strdup(proc_fs);
+  mon->tracked = calloc(tracked_num, sizeof(*mon->tracked));
+  mon->tracked_num = tracked_num;
+  mon->synced = true;
+  return mon;
+}
+
+DEF_TEST(monitor_apply_event__fork_comm_exit) {
+  /* setup */
+  const char *proc_names[] = {"proc1", "proc2"};
+  proc_pids_t **proc_pids = NULL;
+  proc_pids_init(proc_names, STATIC_ARRAY_SIZE(proc_names), &proc_pids);
+  proc_pids_monitor_t *mon = stub_monitor_create(STATIC_ARRAY_SIZE(proc_names));
+  pids_list_add_pid(&mon->tracked[0], 1007);
+  pids_list_add_pid(&mon->tracked[1], 1010);
+
+  /* process forked by the main thread inherits its name */
+  struct proc_event ev = {.what = PROC_EVENT_FORK};
+  ev.event_data.fork.parent_pid = 1007;
+  ev.event_data.fork.parent_tgid = 1007;
+  ev.event_data.fork.child_pid = 1008;
+  ev.event_data.fork.child_tgid = 1008;
+  monitor_apply_event(mon, proc_pids, &ev);
+  EXPECT_EQ_INT(1, pids_list_contains_pid(&mon->tracked[0], 1008));
+
+  /* new threads are not tracked */
+  ev.event_data.fork.child_pid = 1009;
+  ev.event_data.fork.child_tgid = 1007;
+  monitor_apply_event(mon, proc_pids, &ev);
+  EXPECT_EQ_INT(0, pids_list_contains_pid(&mon->tracked[0], 1009));
+  EXPECT_EQ_INT(2, mon->tracked[0].size);
+
+  /* renamed process moves to the other list */
+  ev = (struct proc_event){.what = PROC_EVENT_COMM};
+  ev.event_data.comm.process_pid = 1008;
+  ev.event_data.comm.process_tgid = 1008;
+  sstrncpy(ev.event_data.comm.comm, "proc2", sizeof(ev.event_data.comm.comm));
+  monitor_apply_event(mon, proc_pids, &ev);
+  EXPECT_EQ_INT(0, pids_list_contains_pid(&mon->tracked[0], 1008));
+  EXPECT_EQ_INT(1, pids_list_contains_pid(&mon->tracked[1], 1008));
+
+  /* thread exit keeps the process, process exit removes it */
+  ev = (struct proc_event){.what = PROC_EVENT_EXIT};
+  ev.event_data.exit.process_pid = 1011;
+  ev.event_data.exit.process_tgid = 1010;
+  monitor_apply_event(mon, proc_pids, &ev);
+  EXPECT_EQ_INT(1, pids_list_contains_pid(&mon->tracked[1], 1010));
+  ev.event_data.exit.process_pid = 1010;
+  monitor_apply_event(mon, proc_pids, &ev);
+  EXPECT_EQ_INT(0, pids_list_contains_pid(&mon->tracked[1], 1010));
+  EXPECT_EQ_INT(1, mon->tracked[0].size);
+  EXPECT_EQ_INT(1, mon->tracked[1].size);
+
+  /* cleanup */
+  proc_pids_monitor_destroy(mon);
+  proc_pids_free(proc_pids, STATIC_ARRAY_SIZE(proc_names));
+  return 0;
+}
+
+DEF_TEST(monitor_apply_event__exec) {
+  /* setup */
+  const char *proc_names[] = {"proc1", "proc2"};
+  stub_proc_pid_t pp_stubs[] = {{"proc1", 1007}, {"proc3", 1008}};
+  stub_procfs_setup(pp_stubs, STATIC_ARRAY_SIZE(pp_stubs));
+  proc_pids_t **proc_pids = NULL;
+  proc_pids_init(proc_names, STATIC_ARRAY_SIZE(proc_names), &proc_pids);
+  proc_pids_monitor_t *mon = stub_monitor_create(STATIC_ARRAY_SIZE(proc_names));
+  pids_list_add_pid(&mon->tracked[1], 1007);
+  pids_list_add_pid(&mon->tracked[1], 1008);
+
+  /* name after exec is read from procfs */
+  struct proc_event ev = {.what = PROC_EVENT_EXEC};
+  ev.event_data.exec.process_pid = 1007;
+  ev.event_data.exec.process_tgid = 1007;
+  monitor_apply_event(mon, proc_pids, &ev);
+  EXPECT_EQ_INT(1, pids_list_contains_pid(&mon->tracked[0], 1007));
+  EXPECT_EQ_INT(0, pids_list_contains_pid(&mon->tracked[1], 1007));
+
+  ev.event_data.exec.process_pid = 1008;
+  ev.event_data.exec.process_tgid = 1008;
+  monitor_apply_event(mon, proc_pids, &ev);
+  EXPECT_EQ_INT(0, mon->tracked[1].size);
+
+  /* process already gone */
+  pids_list_add_pid(&mon->tracked[1], 1020);
+  ev.event_data.exec.process_pid = 1020;
+  ev.event_data.exec.process_tgid = 1020;
+  monitor_apply_event(mon, proc_pids, &ev);
+  EXPECT_EQ_INT(0, mon->tracked[1].size);
+
+  /* cleanup */
+  proc_pids_monitor_destroy(mon);
+  proc_pids_free(proc_pids, STATIC_ARRAY_SIZE(proc_names));
+  stub_procfs_teardown();
+  return 0;
+}
+
 int main(void) {
   stub_procfs_teardown();
   RUN_TEST(proc_pids_init__on_nullptr);
@@ -506,6 +606,8 @@ int main(void) {
   RUN_TEST(pids_list_diff__nothing_changed);
   RUN_TEST(pids_list_diff__one_added);
   RUN_TEST(pids_list_diff__one_removed);
+  RUN_TEST(monitor_apply_event__fork_comm_exit);
+  RUN_TEST(monitor_apply_event__exec);
   stub_procfs_teardown();
   END_TEST;
 }
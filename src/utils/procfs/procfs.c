@@ -0,0 +1,232 @@
+/**
+ * collectd - src/utils/procfs/procfs.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "utils/common/common.h"
+#include "utils/procfs/procfs.h"
+
+#include <fcntl.h>
+
+#define PROCFS_BUFFER_SIZE 4096
+
+struct cu_procfs_s {
+  int fd;
+  char *buffer;
+  size_t buffer_size;
+
+  /* For each line, the index of the key found in it plus one, or zero, as of
+   * the last time all lines were compared with all keys. */
+  uint32_t *hints;
+  size_t hints_num;
+  /* Number of keys found the last time all lines were compared. */
+  int hints_found;
+};
+
+cu_procfs_t *cu_procfs_open(char const *path) /* {{{ */
+{
+  cu_procfs_t *pf = calloc(1, sizeof(*pf));
+  if (pf == NULL)
+    return NULL;
+
+  pf->fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (pf->fd < 0) {
+    int status = errno;
+    sfree(pf);
+    errno = status;
+    return NULL;
+  }
+
+  return pf;
+} /* }}} cu_procfs_t *cu_procfs_open */
+
+void cu_procfs_close(cu_procfs_t *pf) /* {{{ */
+{
+  if (pf == NULL)
+    return;
+
+  close(pf->fd);
+  sfree(pf->buffer);
+  sfree(pf->hints);
+  sfree(pf);
+} /* }}} void cu_procfs_close */
+
+char *cu_procfs_read(cu_procfs_t *pf, size_t *ret_size) /* {{{ */
+{
+  size_t size = 0;
+
+  while (42) {
+    /* Keep room for the null byte. */
+    if ((size + 1) >= pf->buffer_size) {
+      size_t new_size =
+          (pf->buffer_size == 0) ? PROCFS_BUFFER_SIZE : 2 * pf->buffer_size;
+      char *tmp = realloc(pf->buffer, new_size);
+      if (tmp == NULL)
+        return NULL;
+      pf->buffer = tmp;
+      pf->buffer_size = new_size;
+    }
+
+    ssize_t status = pread(pf->fd, pf->buffer + size,
+                           pf->buffer_size - (size + 1), (off_t)size);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      return NULL;
+    } else if (status == 0) {
+      break;
+    }
+
+    size += (size_t)status;
+  }
+
+  pf->buffer[size] = 0;
+  if (ret_size != NULL)
+    *ret_size = size;
+  return pf->buffer;
+} /* }}} char *cu_procfs_read */
+
+char *cu_procfs_line(char **cursor) /* {{{ */
+{
+  char *line = *cursor;
+  if ((line == NULL) || (line[0] == 0))
+    return NULL;
+
+  char *end = strchr(line, '\n');
+  if (end == NULL) {
+    *cursor = line + strlen(line);
+  } else {
+    *end = 0;
+    *cursor = end + 1;
+  }
+
+  return line;
+} /* }}} char *cu_procfs_line */
+
+char *cu_procfs_scan_u64(char const *str, uint64_t *ret_value) /* {{{ */
+{
+  while ((*str == ' ') || (*str == '\t'))
+    str++;
+
+  if ((*str < '0') || (*str > '9'))
+    return NULL;
+
+  uint64_t value = 0;
+  while ((*str >= '0') && (*str <= '9')) {
+    value = 10 * value + (uint64_t)(*str - '0');
+    str++;
+  }
+
+  *ret_value = value;
+  return (char *)str;
+} /* }}} char *cu_procfs_scan_u64 */
+
+/* Sets `key' from `line' if the line starts with the key. */
+static bool key_match(cu_procfs_key_t *key, char const *line) /* {{{ */
+{
+  size_t len = strlen(key->key);
+  if ((strncmp(line, key->key, len) != 0) ||
+      ((line[len] != ' ') && (line[len] != '\t')))
+    return false;
+
+  uint64_t value = 0;
+  if (cu_procfs_scan_u64(line + len, &value) == NULL)
+    return false;
+
+  key->value = value;
+  key->found = true;
+  return true;
+} /* }}} bool key_match */
+
+/* Compares every line with every key and remembers where the keys were
+ * found. */
+static int keys_match_all(cu_procfs_t *pf, char *data, /* {{{ */
+                          cu_procfs_key_t *keys, size_t keys_num) {
+  size_t lines_num = 0;
+  for (char *p = data; *p != 0; p++)
+    if (*p == '\n')
+      lines_num++;
+  lines_num++;
+
+  if (lines_num > pf->hints_num) {
+    uint32_t *tmp = realloc(pf->hints, lines_num * sizeof(*pf->hints));
+    if (tmp == NULL)
+      return -1;
+    pf->hints = tmp;
+  }
+  pf->hints_num = lines_num;
+
+  int found = 0;
+  size_t index = 0;
+  for (char const *line = data; line != NULL; index++) {
+    pf->hints[index] = 0;
+    for (size_t i = 0; i < keys_num; i++) {
+      if (keys[i].found || !key_match(keys + i, line))
+        continue;
+      pf->hints[index] = (uint32_t)(i + 1);
+      found++;
+      break;
+    }
+
+    line = strchr(line, '\n');
+    if (line != NULL)
+      line++;
+  }
+
+  pf->hints_found = found;
+  return found;
+} /* }}} int keys_match_all */
+
+int cu_procfs_read_keys(cu_procfs_t *pf, cu_procfs_key_t *keys, /* {{{ */
+                        size_t keys_num) {
+  char *data = cu_procfs_read(pf, NULL);
+  if (data == NULL)
+    return -1;
+
+  for (size_t i = 0; i < keys_num; i++)
+    keys[i].found = false;
+
+  if (pf->hints == NULL)
+    return keys_match_all(pf, data, keys, keys_num);
+
+  int found = 0;
+  size_t index = 0;
+  for (char const *line = data; (line != NULL) && (index < pf->hints_num);
+       index++) {
+    uint32_t hint = pf->hints[index];
+    if ((hint != 0) && (hint <= keys_num) && key_match(keys + hint - 1, line))
+      found++;
+
+    line = strchr(line, '\n');
+    if (line != NULL)
+      line++;
+  }
+
+  if (found >= pf->hints_found)
+    return found;
+
+  /* The lines have moved. */
+  for (size_t i = 0; i < keys_num; i++)
+    keys[i].found = false;
+  return keys_match_all(pf, data, keys, keys_num);
+} /* }}} int cu_procfs_read_keys */
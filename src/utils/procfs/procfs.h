@@ -0,0 +1,132 @@
+/**
+ * collectd - src/utils/procfs/procfs.h
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_PROCFS_H
+#define UTILS_PROCFS_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Reads text files below /proc that are read again every interval. The file
+ * stays open and is read with pread(2) into a buffer that is reused, so
+ * reading it costs neither open(2) nor stdio buffering.
+ */
+
+struct cu_procfs_s;
+typedef struct cu_procfs_s cu_procfs_t;
+
+/* A line of the form "<key> <number> ...", e.g. "MemTotal: 16316412 kB". */
+typedef struct {
+  /* First field of the line, including a trailing colon if any. */
+  char const *key;
+  /* First number following the key. */
+  uint64_t value;
+  bool found;
+} cu_procfs_key_t;
+
+/*
+ * NAME
+ *   cu_procfs_open
+ *
+ * DESCRIPTION
+ *   Opens `path' for reading with cu_procfs_read() and cu_procfs_read_keys().
+ *
+ * RETURN VALUE
+ *   The new handle, or NULL with errno set on error.
+ */
+cu_procfs_t *cu_procfs_open(char const *path);
+
+/*
+ * NAME
+ *   cu_procfs_close
+ *
+ * DESCRIPTION
+ *   Closes the file and frees `pf'. `pf' may be NULL.
+ */
+void cu_procfs_close(cu_procfs_t *pf);
+
+/*
+ * NAME
+ *   cu_procfs_read
+ *
+ * DESCRIPTION
+ *   Reads the whole file again. The content is null-terminated and owned by
+ *   `pf'; it may be modified, e.g. with cu_procfs_line(), and is valid until
+ *   the next read. If `ret_size' is not NULL, the size of the content is
+ *   stored there.
+ *
+ * RETURN VALUE
+ *   The content of the file, or NULL with errno set on error.
+ */
+char *cu_procfs_read(cu_procfs_t *pf, size_t *ret_size);
+
+/*
+ * NAME
+ *   cu_procfs_read_keys
+ *
+ * DESCRIPTION
+ *   Reads the file again and sets the value of each of the `keys_num' keys
+ *   found in it, i.e. of the first line starting with the key followed by a
+ *   blank and a number. The lines the keys were found in are remembered, so
+ *   that the next reads only have to compare one key per line. The lines are
+ *   looked up again if fewer keys are found that way. A handle must therefore
+ *   always be used with the same keys.
+ *
+ * RETURN VALUE
+ *   The number of keys found, or -1 with errno set on error.
+ */
+int cu_procfs_read_keys(cu_procfs_t *pf, cu_procfs_key_t *keys,
+                        size_t keys_num);
+
+/*
+ * NAME
+ *   cu_procfs_line
+ *
+ * DESCRIPTION
+ *   Returns the line `*cursor' points to, replacing its newline with a null
+ *   byte, and moves `*cursor' to the next line. Start with the content
+ *   returned by cu_procfs_read().
+ *
+ * RETURN VALUE
+ *   The line, or NULL at the end of the content.
+ */
+char *cu_procfs_line(char **cursor);
+
+/*
+ * NAME
+ *   cu_procfs_scan_u64
+ *
+ * DESCRIPTION
+ *   Parses the unsigned decimal number at the beginning of `str', after
+ *   skipping spaces and tabs, and stores it in `ret_value'. Unlike strtoull(3)
+ *   this neither checks for overflows nor honors the locale.
+ *
+ * RETURN VALUE
+ *   A pointer to the first character after the number, or NULL if `str' does
+ *   not start with a number.
+ */
+char *cu_procfs_scan_u64(char const *str, uint64_t *ret_value);
+
+#endif /* UTILS_PROCFS_H */
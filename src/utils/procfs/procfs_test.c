@@ -0,0 +1,173 @@
+/**
+ * collectd - src/utils/procfs/procfs_test.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/common/common.h"
+#include "utils/procfs/procfs.h"
+
+static char path[64];
+
+/* Replaces the content of the file at `path', like the kernel does for the
+ * files below /proc between reads. */
+static int write_file(char const *content) {
+  FILE *fh = fopen(path, "w");
+  if (fh == NULL)
+    return -1;
+  fputs(content, fh);
+  return fclose(fh);
+}
+
+DEF_TEST(scan_u64) {
+  struct {
+    char const *str;
+    uint64_t want;
+    size_t want_len;
+  } cases[] = {
+      {"42", 42, 2},
+      {"  \t1234 kB", 1234, 7},
+      {"18446744073709551615", UINT64_MAX, 20},
+      {"0x10", 0, 1},
+      {"", 0, 0},
+      {"-1", 0, 0},
+      {"kB", 0, 0},
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    uint64_t got = 0;
+    char *end = cu_procfs_scan_u64(cases[i].str, &got);
+    if (cases[i].want_len == 0) {
+      EXPECT_EQ_PTR(NULL, end);
+      continue;
+    }
+    CHECK_NOT_NULL(end);
+    EXPECT_EQ_UINT64(cases[i].want, got);
+    EXPECT_EQ_UINT64(cases[i].want_len, (uint64_t)(end - cases[i].str));
+  }
+
+  return 0;
+}
+
+DEF_TEST(read) {
+  CHECK_ZERO(write_file("cpu  1 2 3\nctxt 42\nlast line"));
+
+  cu_procfs_t *pf = cu_procfs_open(path);
+  CHECK_NOT_NULL(pf);
+
+  size_t size = 0;
+  char *data = cu_procfs_read(pf, &size);
+  CHECK_NOT_NULL(data);
+  EXPECT_EQ_UINT64(28, size);
+
+  char *cursor = data;
+  EXPECT_EQ_STR("cpu  1 2 3", cu_procfs_line(&cursor));
+  EXPECT_EQ_STR("ctxt 42", cu_procfs_line(&cursor));
+  EXPECT_EQ_STR("last line", cu_procfs_line(&cursor));
+  EXPECT_EQ_PTR(NULL, cu_procfs_line(&cursor));
+
+  /* The file is read again from the start, and larger files fit. */
+  char big[3 * 4096 + 1];
+  memset(big, 'x', sizeof(big) - 1);
+  big[sizeof(big) - 1] = 0;
+  CHECK_ZERO(write_file(big));
+  data = cu_procfs_read(pf, &size);
+  CHECK_NOT_NULL(data);
+  EXPECT_EQ_UINT64(sizeof(big) - 1, size);
+  EXPECT_EQ_INT(0, strcmp(big, data));
+
+  cu_procfs_close(pf);
+
+  EXPECT_EQ_PTR(NULL, cu_procfs_open("/does/not/exist"));
+  EXPECT_EQ_INT(ENOENT, errno);
+  return 0;
+}
+
+DEF_TEST(read_keys) {
+  CHECK_ZERO(write_file("MemTotal:       16316412 kB\n"
+                        "MemFree:         1234567 kB\n"
+                        "MemAvailable:    9876543 kB\n"
+                        "Buffers:          345678 kB\n"
+                        "Cached:          5678901 kB\n"));
+
+  cu_procfs_key_t keys[] = {
+      {.key = "MemFree:"}, {.key = "Cached:"}, {.key = "Mem"},
+      {.key = "SwapTotal:"}, {.key = "MemTotal:"},
+  };
+
+  cu_procfs_t *pf = cu_procfs_open(path);
+  CHECK_NOT_NULL(pf);
+
+  EXPECT_EQ_INT(3, cu_procfs_read_keys(pf, keys, STATIC_ARRAY_SIZE(keys)));
+  EXPECT_EQ_UINT64(1234567, keys[0].value);
+  EXPECT_EQ_UINT64(5678901, keys[1].value);
+  /* keys have to match the whole first field */
+  OK(!keys[2].found);
+  OK(!keys[3].found);
+  EXPECT_EQ_UINT64(16316412, keys[4].value);
+
+  /* Same layout, new values */
+  CHECK_ZERO(write_file("MemTotal:       16316412 kB\n"
+                        "MemFree:               1 kB\n"
+                        "MemAvailable:    9876543 kB\n"
+                        "Buffers:          345678 kB\n"
+                        "Cached:         12345678 kB\n"));
+  EXPECT_EQ_INT(3, cu_procfs_read_keys(pf, keys, STATIC_ARRAY_SIZE(keys)));
+  EXPECT_EQ_UINT64(1, keys[0].value);
+  EXPECT_EQ_UINT64(12345678, keys[1].value);
+  EXPECT_EQ_UINT64(16316412, keys[4].value);
+
+  /* The lines moved: they are looked up again. */
+  CHECK_ZERO(write_file("Cached: 7\n"
+                        "MemTotal: 9\n"
+                        "SwapTotal: 3\n"
+                        "MemFree: 8\n"));
+  EXPECT_EQ_INT(4, cu_procfs_read_keys(pf, keys, STATIC_ARRAY_SIZE(keys)));
+  EXPECT_EQ_UINT64(8, keys[0].value);
+  EXPECT_EQ_UINT64(7, keys[1].value);
+  OK(keys[3].found);
+  EXPECT_EQ_UINT64(3, keys[3].value);
+  EXPECT_EQ_UINT64(9, keys[4].value);
+
+  /* A key went away. */
+  CHECK_ZERO(write_file("Cached: 7\n"
+                        "MemTotal: 9\n"
+                        "MemFree: 8\n"));
+  EXPECT_EQ_INT(3, cu_procfs_read_keys(pf, keys, STATIC_ARRAY_SIZE(keys)));
+  OK(!keys[3].found);
+  EXPECT_EQ_UINT64(8, keys[0].value);
+
+  cu_procfs_close(pf);
+  return 0;
+}
+
+int main(void) {
+  snprintf(path, sizeof(path), "/tmp/collectd-procfs-test-%d", (int)getpid());
+
+  RUN_TEST(scan_u64);
+  RUN_TEST(read);
+  RUN_TEST(read_keys);
+
+  unlink(path);
+  END_TEST;
+}
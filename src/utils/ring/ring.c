@@ -0,0 +1,272 @@
+/**
+ * collectd - src/utils/ring/ring.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/ring/ring.h"
+
+/* This is the bounded MPMC queue described by Dmitry Vyukov: every slot
+ * carries a sequence number which tells producers and consumers whether the
+ * slot is free for the current lap. Positions are claimed with a CAS, so
+ * neither side takes a lock unless it has to wait. */
+
+#define RING_CACHE_LINE 64
+
+#define RING_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define RING_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+struct c_ring_s {
+  /* Read-only after creation. */
+  unsigned char *slots;
+  size_t mask;
+  size_t slot_size;
+  size_t element_size;
+
+  /* Producers and consumers each get their own cache line. */
+  char pad0[RING_CACHE_LINE];
+  size_t head; /* next position to push to */
+  char pad1[RING_CACHE_LINE - sizeof(size_t)];
+  size_t tail; /* next position to pop from */
+  char pad2[RING_CACHE_LINE - sizeof(size_t)];
+
+  /* Number of threads blocked in c_ring_{push,pop}_wait(). */
+  int waiting_producers;
+  int waiting_consumers;
+  int closed;
+
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+};
+
+/* Each slot starts with its sequence number, followed by the element. */
+#define SLOT(r, pos) ((r)->slots + ((pos) & (r)->mask) * (r)->slot_size)
+#define SLOT_SEQ(slot) ((size_t *)(slot))
+#define SLOT_DATA(slot) ((slot) + sizeof(size_t))
+
+c_ring_t *c_ring_create(size_t capacity, size_t element_size) {
+  if ((capacity < 2) || (element_size == 0))
+    return NULL;
+
+  size_t size = 2;
+  while (size < capacity) {
+    if (size > (SIZE_MAX / 2))
+      return NULL;
+    size *= 2;
+  }
+
+  c_ring_t *r = calloc(1, sizeof(*r));
+  if (r == NULL)
+    return NULL;
+
+  /* Round slots up to whole cache lines so that threads working on
+   * neighboring slots don't contend for the same line. */
+  r->element_size = element_size;
+  r->slot_size = sizeof(size_t) + element_size;
+  r->slot_size = (r->slot_size + RING_CACHE_LINE - 1) & ~(RING_CACHE_LINE - 1);
+  r->mask = size - 1;
+
+  if (posix_memalign((void **)&r->slots, RING_CACHE_LINE,
+                     size * r->slot_size) != 0) {
+    free(r);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < size; i++)
+    *SLOT_SEQ(SLOT(r, i)) = i;
+
+  pthread_mutex_init(&r->lock, /* attr = */ NULL);
+  pthread_cond_init(&r->not_empty, /* attr = */ NULL);
+  pthread_cond_init(&r->not_full, /* attr = */ NULL);
+
+  return r;
+} /* c_ring_t *c_ring_create */
+
+void c_ring_destroy(c_ring_t *r) {
+  if (r == NULL)
+    return;
+
+  pthread_mutex_destroy(&r->lock);
+  pthread_cond_destroy(&r->not_empty);
+  pthread_cond_destroy(&r->not_full);
+  free(r->slots);
+  free(r);
+} /* void c_ring_destroy */
+
+/* Must be called after a successful push / pop, so a waiter either sees the
+ * new state when re-checking or is already waiting for the signal. */
+static void ring_wakeup(c_ring_t *r, int *waiting, pthread_cond_t *cond) {
+  /* Order the preceding release store of the slot's sequence number before
+   * the load of `waiting'. */
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(waiting, __ATOMIC_RELAXED) == 0)
+    return;
+
+  pthread_mutex_lock(&r->lock);
+  pthread_cond_signal(cond);
+  pthread_mutex_unlock(&r->lock);
+} /* void ring_wakeup */
+
+static int ring_try_push(c_ring_t *r, void const *element) {
+  size_t pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+
+  while (42) {
+    unsigned char *slot = SLOT(r, pos);
+    size_t seq = RING_LOAD(SLOT_SEQ(slot));
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&r->head, &pos, pos + 1,
+                                      /* weak = */ 1, __ATOMIC_RELAXED,
+                                      __ATOMIC_RELAXED)) {
+        memcpy(SLOT_DATA(slot), element, r->element_size);
+        RING_STORE(SLOT_SEQ(slot), pos + 1);
+        return 0;
+      }
+      /* `pos' has been updated by the failed CAS. */
+    } else if (diff < 0) {
+      return EAGAIN;
+    } else {
+      pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+    }
+  }
+} /* int ring_try_push */
+
+static int ring_try_pop(c_ring_t *r, void *element) {
+  size_t pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+
+  while (42) {
+    unsigned char *slot = SLOT(r, pos);
+    size_t seq = RING_LOAD(SLOT_SEQ(slot));
+    intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&r->tail, &pos, pos + 1,
+                                      /* weak = */ 1, __ATOMIC_RELAXED,
+                                      __ATOMIC_RELAXED)) {
+        memcpy(element, SLOT_DATA(slot), r->element_size);
+        RING_STORE(SLOT_SEQ(slot), pos + r->mask + 1);
+        return 0;
+      }
+    } else if (diff < 0) {
+      return EAGAIN;
+    } else {
+      pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+    }
+  }
+} /* int ring_try_pop */
+
+int c_ring_push(c_ring_t *r, void const *element) {
+  int status = ring_try_push(r, element);
+  if (status == 0)
+    ring_wakeup(r, &r->waiting_consumers, &r->not_empty);
+  return status;
+} /* int c_ring_push */
+
+int c_ring_pop(c_ring_t *r, void *element) {
+  int status = ring_try_pop(r, element);
+  if (status == 0)
+    ring_wakeup(r, &r->waiting_producers, &r->not_full);
+  return status;
+} /* int c_ring_pop */
+
+/* Common implementation of the blocking functions. `try' is retried after
+ * registering as a waiter, which closes the race with a concurrent
+ * ring_wakeup() that didn't see us yet. */
+static int ring_wait(c_ring_t *r, int (*try)(c_ring_t *, void *), void *element,
+                     int *waiting, pthread_cond_t *cond) {
+  pthread_mutex_lock(&r->lock);
+  __atomic_add_fetch(waiting, 1, __ATOMIC_SEQ_CST);
+  while (42) {
+    if (r->closed) {
+      __atomic_sub_fetch(waiting, 1, __ATOMIC_SEQ_CST);
+      pthread_mutex_unlock(&r->lock);
+      return ECANCELED;
+    }
+
+    if ((*try)(r, element) == 0)
+      break;
+
+    pthread_cond_wait(cond, &r->lock);
+  }
+  __atomic_sub_fetch(waiting, 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&r->lock);
+  return 0;
+} /* int ring_wait */
+
+static int ring_try_push_cb(c_ring_t *r, void *element) {
+  return ring_try_push(r, element);
+}
+
+int c_ring_push_wait(c_ring_t *r, void const *element) {
+  if (__atomic_load_n(&r->closed, __ATOMIC_RELAXED))
+    return ECANCELED;
+
+  if (ring_try_push(r, element) != 0) {
+    int status = ring_wait(r, ring_try_push_cb, (void *)element,
+                           &r->waiting_producers, &r->not_full);
+    if (status != 0)
+      return status;
+  }
+
+  ring_wakeup(r, &r->waiting_consumers, &r->not_empty);
+  return 0;
+} /* int c_ring_push_wait */
+
+int c_ring_pop_wait(c_ring_t *r, void *element) {
+  if (__atomic_load_n(&r->closed, __ATOMIC_RELAXED))
+    return ECANCELED;
+
+  if (ring_try_pop(r, element) != 0) {
+    int status = ring_wait(r, ring_try_pop, element, &r->waiting_consumers,
+                           &r->not_empty);
+    if (status != 0)
+      return status;
+  }
+
+  ring_wakeup(r, &r->waiting_producers, &r->not_full);
+  return 0;
+} /* int c_ring_pop_wait */
+
+void c_ring_close(c_ring_t *r) {
+  pthread_mutex_lock(&r->lock);
+  __atomic_store_n(&r->closed, 1, __ATOMIC_RELAXED);
+  pthread_cond_broadcast(&r->not_empty);
+  pthread_cond_broadcast(&r->not_full);
+  pthread_mutex_unlock(&r->lock);
+} /* void c_ring_close */
+
+size_t c_ring_size(c_ring_t *r) {
+  size_t tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+  size_t head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+
+  if (head <= tail)
+    return 0;
+  return head - tail;
+} /* size_t c_ring_size */
@@ -0,0 +1,127 @@
+/**
+ * collectd - src/utils/ring/ring.h
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_RING_H
+#define UTILS_RING_H 1
+
+#include <stddef.h>
+
+/*
+ * Bounded multi-producer / multi-consumer queue. Elements are copied into
+ * fixed-size slots, so pushing and popping does not allocate memory. The
+ * non-blocking functions don't take any lock; the blocking variants only take
+ * the ring's mutex if they actually have to wait, and producers (consumers)
+ * only signal the other side if somebody is waiting.
+ */
+struct c_ring_s;
+typedef struct c_ring_s c_ring_t;
+
+/*
+ * NAME
+ *   c_ring_create
+ *
+ * DESCRIPTION
+ *   Allocates a new ring.
+ *
+ * PARAMETERS
+ *   `capacity'      Maximum number of elements. Rounded up to the next power
+ *                   of two.
+ *   `element_size'  Size of one element in bytes.
+ *
+ * RETURN VALUE
+ *   A c_ring_t-pointer upon success or NULL upon failure.
+ */
+c_ring_t *c_ring_create(size_t capacity, size_t element_size);
+
+/*
+ * NAME
+ *   c_ring_destroy
+ *
+ * DESCRIPTION
+ *   Deallocates a ring. Elements still stored in the ring are lost. No thread
+ *   must be using the ring anymore.
+ */
+void c_ring_destroy(c_ring_t *r);
+
+/*
+ * NAME
+ *   c_ring_push
+ *
+ * DESCRIPTION
+ *   Copies `element' into the ring without blocking.
+ *
+ * RETURN VALUE
+ *   Zero upon success, EAGAIN if the ring is full.
+ */
+int c_ring_push(c_ring_t *r, void const *element);
+
+/*
+ * NAME
+ *   c_ring_pop
+ *
+ * DESCRIPTION
+ *   Copies the oldest element into `element' and removes it from the ring,
+ *   without blocking.
+ *
+ * RETURN VALUE
+ *   Zero upon success, EAGAIN if the ring is empty.
+ */
+int c_ring_pop(c_ring_t *r, void *element);
+
+/*
+ * NAME
+ *   c_ring_push_wait, c_ring_pop_wait
+ *
+ * DESCRIPTION
+ *   Like c_ring_push() and c_ring_pop(), but wait until there is room in the
+ *   ring or an element is available, respectively.
+ *
+ * RETURN VALUE
+ *   Zero upon success, ECANCELED if the ring has been closed with
+ *   c_ring_close().
+ */
+int c_ring_push_wait(c_ring_t *r, void const *element);
+int c_ring_pop_wait(c_ring_t *r, void *element);
+
+/*
+ * NAME
+ *   c_ring_close
+ *
+ * DESCRIPTION
+ *   Wakes up all threads waiting in c_ring_push_wait() or c_ring_pop_wait()
+ *   and makes all further calls of these functions fail. The non-blocking
+ *   functions continue to work, e.g. to drain the ring.
+ */
+void c_ring_close(c_ring_t *r);
+
+/*
+ * NAME
+ *   c_ring_size
+ *
+ * DESCRIPTION
+ *   Returns the number of elements in the ring. Since other threads may be
+ *   modifying the ring concurrently, this is a snapshot only.
+ */
+size_t c_ring_size(c_ring_t *r);
+
+#endif /* UTILS_RING_H */
@@ -0,0 +1,137 @@
+/**
+ * collectd - src/utils/ring/ring_test.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/ring/ring.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+DEF_TEST(simple) {
+  c_ring_t *r;
+  int value;
+
+  CHECK_NOT_NULL(r = c_ring_create(3, sizeof(int)));
+  EXPECT_EQ_INT(EAGAIN, c_ring_pop(r, &value));
+
+  /* capacity is rounded up to four */
+  for (int i = 0; i < 4; i++)
+    CHECK_ZERO(c_ring_push(r, &i));
+  value = 4;
+  EXPECT_EQ_INT(EAGAIN, c_ring_push(r, &value));
+  EXPECT_EQ_UINT64(4, c_ring_size(r));
+
+  for (int i = 0; i < 4; i++) {
+    CHECK_ZERO(c_ring_pop(r, &value));
+    EXPECT_EQ_INT(i, value);
+  }
+  EXPECT_EQ_INT(EAGAIN, c_ring_pop(r, &value));
+  EXPECT_EQ_UINT64(0, c_ring_size(r));
+
+  /* wrap around a couple of times */
+  for (int i = 0; i < 20; i++) {
+    CHECK_ZERO(c_ring_push(r, &i));
+    CHECK_ZERO(c_ring_pop(r, &value));
+    EXPECT_EQ_INT(i, value);
+  }
+
+  c_ring_destroy(r);
+  return 0;
+}
+
+#define PRODUCERS 4
+#define CONSUMERS 4
+#define ITEMS 100000
+
+static c_ring_t *shared_ring;
+
+static void *producer(void *arg) {
+  uint64_t id = (uint64_t)(uintptr_t)arg;
+
+  for (uint64_t i = 0; i < ITEMS; i++) {
+    uint64_t value = id * ITEMS + i;
+    if (c_ring_push_wait(shared_ring, &value) != 0)
+      return (void *)1;
+  }
+  return NULL;
+}
+
+static void *consumer(void *arg) {
+  uint64_t *sum = arg;
+  uint64_t value;
+
+  while (c_ring_pop_wait(shared_ring, &value) == 0)
+    *sum += value;
+  return NULL;
+}
+
+DEF_TEST(threads) {
+  pthread_t producers[PRODUCERS];
+  pthread_t consumers[CONSUMERS];
+  uint64_t sums[CONSUMERS] = {0};
+
+  /* small ring, so producers and consumers have to wait for each other */
+  CHECK_NOT_NULL(shared_ring = c_ring_create(16, sizeof(uint64_t)));
+
+  for (size_t i = 0; i < CONSUMERS; i++)
+    CHECK_ZERO(pthread_create(consumers + i, NULL, consumer, sums + i));
+  for (size_t i = 0; i < PRODUCERS; i++)
+    CHECK_ZERO(pthread_create(producers + i, NULL, producer, (void *)i));
+
+  for (size_t i = 0; i < PRODUCERS; i++) {
+    void *ret = NULL;
+    CHECK_ZERO(pthread_join(producers[i], &ret));
+    EXPECT_EQ_PTR(NULL, ret);
+  }
+
+  /* wait for the consumers to drain the ring before closing it */
+  while (c_ring_size(shared_ring) != 0)
+    sched_yield();
+  c_ring_close(shared_ring);
+
+  uint64_t sum = 0;
+  for (size_t i = 0; i < CONSUMERS; i++) {
+    CHECK_ZERO(pthread_join(consumers[i], NULL));
+    sum += sums[i];
+  }
+
+  uint64_t n = PRODUCERS * ITEMS;
+  EXPECT_EQ_UINT64(n * (n - 1) / 2, sum);
+
+  uint64_t value = 0;
+  EXPECT_EQ_INT(ECANCELED, c_ring_push_wait(shared_ring, &value));
+  EXPECT_EQ_INT(ECANCELED, c_ring_pop_wait(shared_ring, &value));
+
+  c_ring_destroy(shared_ring);
+  shared_ring = NULL;
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(simple);
+  RUN_TEST(threads);
+
+  END_TEST;
+}
@@ -26,27 +26,36 @@
 
 #include "collectd.h"
 
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 #include "utils/rrdcreate/rrdcreate.h"
+#include "utils_complain.h"
 
 #include <pthread.h>
 #include <rrd.h>
 
+#define RRD_CREATE_THREADS_DEFAULT 4
+
+struct srrd_create_args_s;
+typedef struct srrd_create_args_s srrd_create_args_t;
 struct srrd_create_args_s {
   char *filename;
   unsigned long pdp_step;
   time_t last_up;
   int argc;
   char **argv;
+  bool use_template;
+  srrd_create_args_t *next;
 };
-typedef struct srrd_create_args_s srrd_create_args_t;
 
-struct async_create_file_s;
-typedef struct async_create_file_s async_create_file_t;
-struct async_create_file_s {
-  char *filename;
-  async_create_file_t *next;
+/* An empty RRD file, which is copied to create files with the same step,
+ * data sources and RRAs. */
+struct srrd_template_s {
+  char *data;
+  size_t size;
+  time_t last_up;
 };
+typedef struct srrd_template_s srrd_template_t;
 
 /*
  * Private variables
@@ -61,8 +70,23 @@ static int rra_types_num = STATIC_ARRAY_SIZE(rra_types);
 static pthread_mutex_t librrd_lock = PTHREAD_MUTEX_INITIALIZER;
 #endif
 
-static async_create_file_t *async_creation_list;
+/* Names of the files currently being created, protected by
+ * async_creation_lock. So are the queue of files waiting for one of the
+ * creation threads and the threads themselves. */
+static c_avl_tree_t *async_creation_tree;
 static pthread_mutex_t async_creation_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t async_creation_cond = PTHREAD_COND_INITIALIZER;
+static srrd_create_args_t *async_queue_head;
+static srrd_create_args_t *async_queue_tail;
+static size_t async_queue_length;
+static pthread_t *create_threads;
+static size_t create_threads_num;
+static bool async_shutdown;
+static c_complain_t async_queue_complaint = C_COMPLAIN_INIT_STATIC;
+
+/* Maps a layout, as returned by srrd_template_key(), to a srrd_template_t. */
+static c_avl_tree_t *templates;
+static pthread_mutex_t templates_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /*
  * Private functions
@@ -400,17 +424,22 @@ static int srrd_create(const char *filename, /* {{{ */
 
 static int lock_file(char const *filename) /* {{{ */
 {
-  async_create_file_t *ptr;
+  char *key;
   struct stat sb;
   int status;
 
   pthread_mutex_lock(&async_creation_lock);
 
-  for (ptr = async_creation_list; ptr != NULL; ptr = ptr->next)
-    if (strcmp(filename, ptr->filename) == 0)
-      break;
+  if (async_creation_tree == NULL) {
+    async_creation_tree =
+        c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (async_creation_tree == NULL) {
+      pthread_mutex_unlock(&async_creation_lock);
+      return ENOMEM;
+    }
+  }
 
-  if (ptr != NULL) {
+  if (c_avl_get(async_creation_tree, filename, NULL) == 0) {
     pthread_mutex_unlock(&async_creation_lock);
     return EEXIST;
   }
@@ -421,22 +450,13 @@ static int lock_file(char const *filename) /* {{{ */
     return EEXIST;
   }
 
-  ptr = malloc(sizeof(*ptr));
-  if (ptr == NULL) {
-    pthread_mutex_unlock(&async_creation_lock);
-    return ENOMEM;
-  }
-
-  ptr->filename = strdup(filename);
-  if (ptr->filename == NULL) {
+  key = strdup(filename);
+  if ((key == NULL) || (c_avl_insert(async_creation_tree, key, NULL) != 0)) {
     pthread_mutex_unlock(&async_creation_lock);
-    sfree(ptr);
+    sfree(key);
     return ENOMEM;
   }
 
-  ptr->next = async_creation_list;
-  async_creation_list = ptr;
-
   pthread_mutex_unlock(&async_creation_lock);
 
   return 0;
@@ -444,126 +464,331 @@ static int lock_file(char const *filename) /* {{{ */
 
 static int unlock_file(char const *filename) /* {{{ */
 {
-  async_create_file_t *this;
-  async_create_file_t *prev;
+  char *key = NULL;
+  int status;
 
   pthread_mutex_lock(&async_creation_lock);
+  if (async_creation_tree != NULL)
+    status = c_avl_remove(async_creation_tree, filename, (void *)&key, NULL);
+  else
+    status = ENOENT;
+  pthread_mutex_unlock(&async_creation_lock);
 
-  prev = NULL;
-  for (this = async_creation_list; this != NULL; this = this->next) {
-    if (strcmp(filename, this->filename) == 0)
-      break;
-    prev = this;
-  }
+  if (status != 0)
+    return ENOENT;
 
-  if (this == NULL) {
-    pthread_mutex_unlock(&async_creation_lock);
+  sfree(key);
+  return 0;
+} /* }}} int unlock_file */
+
+/* Returns a string describing the layout of a file, which is used to look up
+ * its template. */
+static char *srrd_template_key(unsigned long pdp_step, int argc, /* {{{ */
+                               const char **argv) {
+  size_t size = 32;
+  size_t len;
+  char *key;
+
+  for (int i = 0; i < argc; i++)
+    size += strlen(argv[i]) + 1;
+
+  key = malloc(size);
+  if (key == NULL)
+    return NULL;
+
+  len = (size_t)ssnprintf(key, size, "%lu", pdp_step);
+  for (int i = 0; i < argc; i++)
+    len += (size_t)ssnprintf(key + len, size - len, " %s", argv[i]);
+
+  return key;
+} /* }}} char *srrd_template_key */
+
+/* Writes a copy of the template with the layout "key" to "filename". Returns
+ * ENOENT if there is no template or if the template's last update is after
+ * "last_up", in which case the file would reject the first values. */
+static int srrd_template_copy(char const *key, char const *filename, /* {{{ */
+                              time_t last_up) {
+  srrd_template_t *t = NULL;
+  int fd;
+
+  pthread_mutex_lock(&templates_lock);
+  if ((templates == NULL) || (c_avl_get(templates, key, (void *)&t) != 0) ||
+      (t->last_up > last_up)) {
+    pthread_mutex_unlock(&templates_lock);
     return ENOENT;
   }
+  /* Templates are never replaced and only freed on shutdown. */
+  pthread_mutex_unlock(&templates_lock);
 
-  if (prev == NULL) {
-    assert(this == async_creation_list);
-    async_creation_list = this->next;
-  } else {
-    assert(this == prev->next);
-    prev->next = this->next;
+  fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  if (fd < 0) {
+    int status = errno;
+    P_ERROR("srrd_template_copy: open (%s) failed: %s", filename, STRERRNO);
+    return status;
   }
-  this->next = NULL;
 
-  pthread_mutex_unlock(&async_creation_lock);
+  for (size_t done = 0; done < t->size;) {
+    ssize_t status = write(fd, t->data + done, t->size - done);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      status = errno;
+      P_ERROR("srrd_template_copy: write (%s) failed: %s", filename,
+              STRERRNO);
+      close(fd);
+      unlink(filename);
+      return (int)status;
+    }
+    done += (size_t)status;
+  }
 
-  sfree(this->filename);
-  sfree(this);
+  if (close(fd) != 0) {
+    int status = errno;
+    P_ERROR("srrd_template_copy: close (%s) failed: %s", filename, STRERRNO);
+    unlink(filename);
+    return status;
+  }
 
   return 0;
-} /* }}} int unlock_file */
+} /* }}} int srrd_template_copy */
+
+/* Reads the freshly created file "filename" and keeps it as the template for
+ * the layout "key", unless there is a template already. */
+static void srrd_template_add(char const *key, char const *filename, /* {{{ */
+                              time_t last_up) {
+  srrd_template_t *t;
+  char *key_copy;
+  struct stat sb;
+  int fd;
 
-static void *srrd_create_thread(void *targs) /* {{{ */
-{
-  srrd_create_args_t *args = targs;
-  char tmpfile[PATH_MAX];
+  pthread_mutex_lock(&templates_lock);
+  if (templates == NULL)
+    templates = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if ((templates == NULL) || (c_avl_get(templates, key, NULL) == 0)) {
+    pthread_mutex_unlock(&templates_lock);
+    return;
+  }
+  pthread_mutex_unlock(&templates_lock);
+
+  fd = open(filename, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return;
+
+  t = calloc(1, sizeof(*t));
+  key_copy = strdup(key);
+  if ((t == NULL) || (key_copy == NULL) || (fstat(fd, &sb) != 0) ||
+      (sb.st_size <= 0) || ((t->data = malloc(sb.st_size)) == NULL)) {
+    close(fd);
+    sfree(key_copy);
+    sfree(t);
+    return;
+  }
+  t->last_up = last_up;
+
+  while (t->size < (size_t)sb.st_size) {
+    ssize_t status = read(fd, t->data + t->size, sb.st_size - t->size);
+    if ((status < 0) && (errno == EINTR))
+      continue;
+    if (status <= 0)
+      break;
+    t->size += (size_t)status;
+  }
+  close(fd);
+
+  pthread_mutex_lock(&templates_lock);
+  if ((t->size != (size_t)sb.st_size) ||
+      (c_avl_insert(templates, key_copy, t) != 0)) {
+    pthread_mutex_unlock(&templates_lock);
+    sfree(key_copy);
+    sfree(t->data);
+    sfree(t);
+    return;
+  }
+  pthread_mutex_unlock(&templates_lock);
+
+  DEBUG("srrd_template_add: Using \"%s\" as template for \"%s\".", filename,
+        key);
+} /* }}} void srrd_template_add */
+
+/* Creates "filename", either by copying the template of its layout or with
+ * librrd. In the latter case, the new file becomes the template. */
+static int srrd_create_file(const char *filename, /* {{{ */
+                            unsigned long pdp_step, time_t last_up, int argc,
+                            const char **argv, bool use_template) {
+  char *key;
   int status;
 
-  status = lock_file(args->filename);
-  if (status != 0) {
-    if (status == EEXIST)
-      P_NOTICE("srrd_create_thread: File \"%s\" is already being created.",
-               args->filename);
-    else
-      P_ERROR("srrd_create_thread: Unable to lock file \"%s\".",
-              args->filename);
-    srrd_create_args_destroy(args);
-    return 0;
+  if (!use_template)
+    return srrd_create(filename, pdp_step, last_up, argc, argv);
+
+  key = srrd_template_key(pdp_step, argc, argv);
+  if (key == NULL)
+    return srrd_create(filename, pdp_step, last_up, argc, argv);
+
+  status = srrd_template_copy(key, filename, last_up);
+  if (status == ENOENT) {
+    status = srrd_create(filename, pdp_step, last_up, argc, argv);
+    if (status == 0)
+      srrd_template_add(key, filename, last_up);
   }
 
+  sfree(key);
+  return status;
+} /* }}} int srrd_create_file */
+
+/* Creates the file in "args", which has been locked by srrd_create_async(). */
+static void srrd_create_async_file(srrd_create_args_t *args) /* {{{ */
+{
+  char tmpfile[PATH_MAX];
+  int status;
+
   ssnprintf(tmpfile, sizeof(tmpfile), "%s.async", args->filename);
 
-  status = srrd_create(tmpfile, args->pdp_step, args->last_up, args->argc,
-                       (void *)args->argv);
+  status = srrd_create_file(tmpfile, args->pdp_step, args->last_up, args->argc,
+                            (void *)args->argv, args->use_template);
   if (status != 0) {
-    P_WARNING("srrd_create_thread: srrd_create (%s) returned status %i.",
+    P_WARNING("srrd_create_async_file: srrd_create (%s) returned status %i.",
               args->filename, status);
     unlink(tmpfile);
     unlock_file(args->filename);
-    srrd_create_args_destroy(args);
-    return 0;
+    return;
   }
 
   status = rename(tmpfile, args->filename);
   if (status != 0) {
-    P_ERROR("srrd_create_thread: rename (\"%s\", \"%s\") failed: %s", tmpfile,
-            args->filename, STRERRNO);
+    P_ERROR("srrd_create_async_file: rename (\"%s\", \"%s\") failed: %s",
+            tmpfile, args->filename, STRERRNO);
     unlink(tmpfile);
     unlock_file(args->filename);
-    srrd_create_args_destroy(args);
-    return 0;
+    return;
   }
 
-  DEBUG("srrd_create_thread: Successfully created RRD file \"%s\".",
+  DEBUG("srrd_create_async_file: Successfully created RRD file \"%s\".",
         args->filename);
 
   unlock_file(args->filename);
-  srrd_create_args_destroy(args);
+} /* }}} void srrd_create_async_file */
 
-  return 0;
+static void *srrd_create_thread(void __attribute__((unused)) * arg) /* {{{ */
+{
+  pthread_mutex_lock(&async_creation_lock);
+  while (!async_shutdown) {
+    srrd_create_args_t *args = async_queue_head;
+
+    if (args == NULL) {
+      pthread_cond_wait(&async_creation_cond, &async_creation_lock);
+      continue;
+    }
+
+    async_queue_head = args->next;
+    if (async_queue_head == NULL)
+      async_queue_tail = NULL;
+    async_queue_length--;
+    pthread_mutex_unlock(&async_creation_lock);
+
+    srrd_create_async_file(args);
+    srrd_create_args_destroy(args);
+
+    pthread_mutex_lock(&async_creation_lock);
+  }
+  pthread_mutex_unlock(&async_creation_lock);
+
+  return NULL;
 } /* }}} void *srrd_create_thread */
 
+/* Starts the creation threads. Must be called with async_creation_lock. */
+static int srrd_create_threads_start(size_t num) /* {{{ */
+{
+  create_threads = calloc(num, sizeof(*create_threads));
+  if (create_threads == NULL)
+    return ENOMEM;
+
+  for (create_threads_num = 0; create_threads_num < num; create_threads_num++) {
+    int status = plugin_thread_create(create_threads + create_threads_num,
+                                      srrd_create_thread, NULL, "rrd create");
+    if (status != 0) {
+      P_ERROR("srrd_create_threads_start: plugin_thread_create failed: %s",
+              STRERROR(status));
+      break;
+    }
+  }
+
+  if (create_threads_num == 0) {
+    sfree(create_threads);
+    return -1;
+  }
+  return 0;
+} /* }}} int srrd_create_threads_start */
+
 static int srrd_create_async(const char *filename, /* {{{ */
                              unsigned long pdp_step, time_t last_up, int argc,
-                             const char **argv) {
+                             const char **argv,
+                             const rrdcreate_config_t *cfg) {
   srrd_create_args_t *args;
-  pthread_t thread;
-  pthread_attr_t attr;
   int status;
 
+  /* Files which are waiting to be created are skipped right away, so that a
+   * new series is only queued once, no matter how many values arrive. */
+  status = lock_file(filename);
+  if (status == EEXIST) {
+    DEBUG("srrd_create_async: File \"%s\" is already being created.",
+          filename);
+    return 0;
+  } else if (status != 0) {
+    P_ERROR("srrd_create_async: Unable to lock file \"%s\".", filename);
+    return status;
+  }
+
   DEBUG("srrd_create_async: Creating \"%s\" in the background.", filename);
 
   args = srrd_create_args_create(filename, pdp_step, last_up, argc, argv);
-  if (args == NULL)
-    return -1;
-
-  status = pthread_attr_init(&attr);
-  if (status != 0) {
-    srrd_create_args_destroy(args);
+  if (args == NULL) {
+    unlock_file(filename);
     return -1;
   }
+  args->use_template = cfg->templates;
 
-  status = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-  if (status != 0) {
-    pthread_attr_destroy(&attr);
-    srrd_create_args_destroy(args);
-    return -1;
+  pthread_mutex_lock(&async_creation_lock);
+
+  if ((create_threads == NULL) && !async_shutdown) {
+    status = srrd_create_threads_start((cfg->async_threads > 0)
+                                           ? (size_t)cfg->async_threads
+                                           : RRD_CREATE_THREADS_DEFAULT);
+    if (status != 0) {
+      pthread_mutex_unlock(&async_creation_lock);
+      unlock_file(filename);
+      srrd_create_args_destroy(args);
+      return status;
+    }
   }
 
-  status = pthread_create(&thread, &attr, srrd_create_thread, args);
-  if (status != 0) {
-    P_ERROR("srrd_create_async: pthread_create failed: %s", STRERROR(status));
-    pthread_attr_destroy(&attr);
+  if (async_shutdown || ((cfg->async_queue_length > 0) &&
+                         (async_queue_length >=
+                          (size_t)cfg->async_queue_length))) {
+    /* The file will be queued again when the next value arrives. The
+     * complaint is never released, so that a queue which keeps running full
+     * is reported less and less often. */
+    if (!async_shutdown)
+      c_complain(LOG_WARNING, &async_queue_complaint,
+                 "srrd_create_async: The creation queue is full (%i files). "
+                 "Postponing the creation of new files.",
+                 cfg->async_queue_length);
+    pthread_mutex_unlock(&async_creation_lock);
+    unlock_file(filename);
     srrd_create_args_destroy(args);
-    return status;
+    return 0;
   }
 
-  pthread_attr_destroy(&attr);
+  if (async_queue_tail == NULL)
+    async_queue_head = args;
+  else
+    async_queue_tail->next = args;
+  async_queue_tail = args;
+  async_queue_length++;
+
+  pthread_cond_signal(&async_creation_cond);
+  pthread_mutex_unlock(&async_creation_lock);
+
   /* args is freed in srrd_create_thread(). */
   return 0;
 } /* }}} int srrd_create_async */
@@ -623,7 +848,7 @@ int cu_rrd_create_file(const char *filename, /* {{{ */
 
   if (cfg->async) {
     status = srrd_create_async(filename, stepsize, last_up, argc,
-                               (const char **)argv);
+                               (const char **)argv, cfg);
     if (status != 0)
       P_WARNING("cu_rrd_create_file: srrd_create_async (%s) "
                 "returned status %i.",
@@ -638,8 +863,8 @@ int cu_rrd_create_file(const char *filename, /* {{{ */
       else
         P_ERROR("cu_rrd_create_file: Unable to lock file \"%s\".", filename);
     } else {
-      status =
-          srrd_create(filename, stepsize, last_up, argc, (const char **)argv);
+      status = srrd_create_file(filename, stepsize, last_up, argc,
+                                (const char **)argv, cfg->templates);
 
       if (status != 0) {
         P_WARNING("cu_rrd_create_file: srrd_create (%s) returned status %i.",
@@ -658,3 +883,50 @@ int cu_rrd_create_file(const char *filename, /* {{{ */
 
   return status;
 } /* }}} int cu_rrd_create_file */
+
+void cu_rrd_create_shutdown(void) /* {{{ */
+{
+  srrd_create_args_t *args;
+  srrd_template_t *t;
+  char *key;
+
+  pthread_mutex_lock(&async_creation_lock);
+  async_shutdown = true;
+  pthread_cond_broadcast(&async_creation_cond);
+  pthread_mutex_unlock(&async_creation_lock);
+
+  /* Files being created are finished, files still waiting in the queue are
+   * created once values arrive after the next start. */
+  for (size_t i = 0; i < create_threads_num; i++)
+    pthread_join(create_threads[i], NULL);
+  sfree(create_threads);
+  create_threads_num = 0;
+
+  pthread_mutex_lock(&async_creation_lock);
+  while ((args = async_queue_head) != NULL) {
+    async_queue_head = args->next;
+    srrd_create_args_destroy(args);
+  }
+  async_queue_tail = NULL;
+  async_queue_length = 0;
+
+  if (async_creation_tree != NULL) {
+    while (c_avl_pick(async_creation_tree, (void *)&key, NULL) == 0)
+      sfree(key);
+    c_avl_destroy(async_creation_tree);
+    async_creation_tree = NULL;
+  }
+  pthread_mutex_unlock(&async_creation_lock);
+
+  pthread_mutex_lock(&templates_lock);
+  if (templates != NULL) {
+    while (c_avl_pick(templates, (void *)&key, (void *)&t) == 0) {
+      sfree(key);
+      sfree(t->data);
+      sfree(t);
+    }
+    c_avl_destroy(templates);
+    templates = NULL;
+  }
+  pthread_mutex_unlock(&templates_lock);
+} /* }}} void cu_rrd_create_shutdown */
@@ -44,10 +44,23 @@ struct rrdcreate_config_s {
   size_t consolidation_functions_num;
 
   bool async;
+  /* Number of threads creating files in the background and the maximum number
+   * of files waiting for them. Zero selects the default number of threads
+   * and an unlimited queue, respectively. */
+  int async_threads;
+  int async_queue_length;
+
+  /* Create new files by copying an empty file with the same layout, which is
+   * kept in memory, instead of calling librrd for each file. */
+  bool templates;
 };
 typedef struct rrdcreate_config_s rrdcreate_config_t;
 
 int cu_rrd_create_file(const char *filename, const data_set_t *ds,
                        const value_list_t *vl, const rrdcreate_config_t *cfg);
 
+/* Waits for the files being created in the background and frees all
+ * resources. */
+void cu_rrd_create_shutdown(void);
+
 #endif /* UTILS_RRDCREATE_H */
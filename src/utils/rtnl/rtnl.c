@@ -0,0 +1,158 @@
+/**
+ * collectd - src/utils/rtnl/rtnl.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+#include "utils/rtnl/rtnl.h"
+
+#include "plugin.h"
+#include "utils/common/common.h"
+
+#include <asm/types.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+typedef struct {
+  rtnl_link_cb_t cb;
+  void *user_data;
+} rtnl_dump_t;
+
+static int rtnl_link_msg_cb(const struct nlmsghdr *nlh, void *arg) {
+  rtnl_dump_t *dump = arg;
+  struct ifinfomsg *ifm = mnl_nlmsg_get_payload(nlh);
+  struct nlattr *attr;
+
+  if (nlh->nlmsg_type != RTM_NEWLINK) {
+    ERROR("utils_rtnl: Don't know how to handle message type %i.",
+          nlh->nlmsg_type);
+    return MNL_CB_ERROR;
+  }
+
+  rtnl_link_t link = {
+      .ifindex = ifm->ifi_index,
+      .flags = ifm->ifi_flags,
+      .nlh = nlh,
+  };
+
+  /* One pass over the attributes collects everything we are interested in. */
+  mnl_attr_for_each(attr, nlh, sizeof(*ifm)) {
+    switch (mnl_attr_get_type(attr)) {
+    case IFLA_IFNAME:
+      if (mnl_attr_validate(attr, MNL_TYPE_STRING) < 0) {
+        ERROR("utils_rtnl: IFLA_IFNAME mnl_attr_validate failed.");
+        return MNL_CB_ERROR;
+      }
+      link.name = mnl_attr_get_str(attr);
+      break;
+#ifdef HAVE_RTNL_LINK_STATS64
+    case IFLA_STATS64:
+      if (mnl_attr_get_payload_len(attr) < sizeof(*link.stats64)) {
+        ERROR("utils_rtnl: IFLA_STATS64 attribute has insufficient data.");
+        return MNL_CB_ERROR;
+      }
+      link.stats64 = mnl_attr_get_payload(attr);
+      break;
+#endif
+    case IFLA_STATS:
+      if (mnl_attr_get_payload_len(attr) < sizeof(*link.stats32)) {
+        ERROR("utils_rtnl: IFLA_STATS attribute has insufficient data.");
+        return MNL_CB_ERROR;
+      }
+      link.stats32 = mnl_attr_get_payload(attr);
+      break;
+    }
+  }
+
+  if (link.name == NULL) {
+    ERROR("utils_rtnl: Link %d has no name.", link.ifindex);
+    return MNL_CB_ERROR;
+  }
+
+  if (dump->cb(&link, dump->user_data) != 0)
+    return MNL_CB_ERROR;
+
+  return MNL_CB_OK;
+} /* int rtnl_link_msg_cb */
+
+struct mnl_socket *rtnl_open(void) {
+  struct mnl_socket *nl = mnl_socket_open(NETLINK_ROUTE);
+  if (nl == NULL) {
+    ERROR("utils_rtnl: mnl_socket_open failed: %s", STRERRNO);
+    return NULL;
+  }
+
+  if (mnl_socket_bind(nl, 0, MNL_SOCKET_AUTOPID) < 0) {
+    ERROR("utils_rtnl: mnl_socket_bind failed: %s", STRERRNO);
+    mnl_socket_close(nl);
+    return NULL;
+  }
+
+  return nl;
+} /* struct mnl_socket *rtnl_open */
+
+int rtnl_link_dump(struct mnl_socket *nl, void *buf, size_t buf_size,
+                   uint32_t ext_mask, rtnl_link_cb_t cb, void *user_data) {
+  static unsigned int seq;
+  rtnl_dump_t dump = {
+      .cb = cb,
+      .user_data = user_data,
+  };
+
+  if ((nl == NULL) || (buf == NULL) || (cb == NULL))
+    return -1;
+
+  unsigned int portid = mnl_socket_get_portid(nl);
+
+  struct nlmsghdr *nlh = mnl_nlmsg_put_header(buf);
+  nlh->nlmsg_type = RTM_GETLINK;
+  nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  nlh->nlmsg_seq = ++seq;
+
+  struct rtgenmsg *rt = mnl_nlmsg_put_extra_header(nlh, sizeof(*rt));
+  rt->rtgen_family = AF_PACKET;
+
+  if ((ext_mask != 0) &&
+      mnl_attr_put_u32_check(nlh, buf_size, IFLA_EXT_MASK, ext_mask) == 0) {
+    ERROR("utils_rtnl: Failed to set IFLA_EXT_MASK.");
+    return -1;
+  }
+
+  if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0) {
+    ERROR("utils_rtnl: mnl_socket_sendto failed: %s", STRERRNO);
+    return -1;
+  }
+
+  ssize_t ret = mnl_socket_recvfrom(nl, buf, buf_size);
+  while (ret > 0) {
+    ret = mnl_cb_run(buf, (size_t)ret, seq, portid,
+                     rtnl_link_msg_cb, &dump);
+    if (ret <= MNL_CB_STOP)
+      break;
+    ret = mnl_socket_recvfrom(nl, buf, buf_size);
+  }
+  if (ret < 0) {
+    ERROR("utils_rtnl: Link dump failed: %s", STRERRNO);
+    return -1;
+  }
+
+  return 0;
+} /* int rtnl_link_dump */
@@ -0,0 +1,62 @@
+/**
+ * collectd - src/utils/rtnl/rtnl.h
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_RTNL_H
+#define UTILS_RTNL_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libmnl/libmnl.h>
+
+struct rtnl_link_stats;
+struct rtnl_link_stats64;
+
+/* rtnl_link_t describes one link of a RTM_GETLINK dump. "stats64" and
+ * "stats32" point into the receive buffer and are NULL if the kernel did not
+ * send the attribute. "nlh" is the complete message, for callers that need
+ * further attributes. */
+typedef struct {
+  int ifindex;
+  unsigned int flags;
+  char const *name;
+  struct rtnl_link_stats64 const *stats64;
+  struct rtnl_link_stats const *stats32;
+  struct nlmsghdr const *nlh;
+} rtnl_link_t;
+
+/* Called once per link. A non-zero return value aborts the dump. */
+typedef int (*rtnl_link_cb_t)(rtnl_link_t const *link, void *user_data);
+
+/* rtnl_open opens and binds a NETLINK_ROUTE socket. Returns NULL on error. */
+struct mnl_socket *rtnl_open(void);
+
+/* rtnl_link_dump requests all links with a single RTM_GETLINK dump and calls
+ * "cb" for each of them. "buf" is used to receive the dump; its size limits
+ * the size of a single message, see MNL_SOCKET_BUFFER_SIZE. "ext_mask" is
+ * sent as IFLA_EXT_MASK if non-zero. Returns zero on success and -1 on
+ * error. */
+int rtnl_link_dump(struct mnl_socket *nl, void *buf, size_t buf_size,
+                   uint32_t ext_mask, rtnl_link_cb_t cb, void *user_data);
+
+#endif /* UTILS_RTNL_H */
@@ -0,0 +1,136 @@
+/**
+ * collectd - src/utils/shm/shm.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils/common/common.h"
+#include "utils/shm/shm.h"
+
+#include "collectd/shm_format.h"
+
+#include <fcntl.h>
+#include <grp.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* The fields all segments start with. */
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t state;
+} cu_shm_prefix_t;
+
+static void close_stale(char const *name, uint32_t magic) /* {{{ */
+{
+  int fd = shm_open(name, O_RDWR, 0);
+  if (fd < 0)
+    return;
+
+  struct stat st = {0};
+  if ((fstat(fd, &st) == 0) &&
+      ((size_t)st.st_size >= sizeof(cu_shm_prefix_t))) {
+    cu_shm_prefix_t *p = mmap(NULL, sizeof(*p), PROT_READ | PROT_WRITE,
+                              MAP_SHARED, fd, 0);
+    if (p != MAP_FAILED) {
+      if (p->magic == magic)
+        __atomic_store_n(&p->state, LCC_SHM_STATE_CLOSED, __ATOMIC_RELEASE);
+      munmap(p, sizeof(*p));
+    }
+  }
+  close(fd);
+
+  if ((shm_unlink(name) != 0) && (errno != ENOENT))
+    P_WARNING("shm_unlink(%s) failed: %s", name, STRERRNO);
+} /* }}} void close_stale */
+
+static void set_group(int fd, char const *name, char const *group) /* {{{ */
+{
+  long int grbuf_size = sysconf(_SC_GETGR_R_SIZE_MAX);
+  if (grbuf_size <= 0)
+    grbuf_size = sysconf(_SC_PAGESIZE);
+  if (grbuf_size <= 0)
+    grbuf_size = 4096;
+  char grbuf[grbuf_size];
+
+  struct group sg;
+  struct group *g = NULL;
+  int status = getgrnam_r(group, &sg, grbuf, sizeof(grbuf), &g);
+  if (status != 0) {
+    P_WARNING("getgrnam_r (%s) failed: %s", group, STRERROR(status));
+    return;
+  }
+  if (g == NULL) {
+    P_WARNING("No such group: `%s'", group);
+    return;
+  }
+
+  if (fchown(fd, (uid_t)-1, g->gr_gid) != 0)
+    P_WARNING("fchown (%s, -1, %i) failed: %s", name, (int)g->gr_gid,
+              STRERRNO);
+} /* }}} void set_group */
+
+void *cu_shm_create(char const *name, uint32_t magic, size_t size, /* {{{ */
+                    int perms, char const *group) {
+  close_stale(name, magic);
+
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, perms);
+  if (fd < 0) {
+    P_ERROR("shm_open(%s) failed: %s", name, STRERRNO);
+    return NULL;
+  }
+  /* shm_open() applies the umask. */
+  if (fchmod(fd, (mode_t)perms) != 0)
+    P_WARNING("fchmod(%s, %04o) failed: %s", name, perms, STRERRNO);
+  if (group != NULL)
+    set_group(fd, name, group);
+
+  if (ftruncate(fd, (off_t)size) != 0) {
+    P_ERROR("ftruncate(%s, %zu) failed: %s", name, size, STRERRNO);
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+  }
+
+  void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) {
+    P_ERROR("mmap(%s) failed: %s", name, STRERRNO);
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+  }
+
+  close(fd);
+  return addr;
+} /* }}} void *cu_shm_create */
+
+void cu_shm_destroy(char const *name, void *addr, size_t size) /* {{{ */
+{
+  if (addr == NULL)
+    return;
+
+  cu_shm_prefix_t *p = addr;
+  __atomic_store_n(&p->state, LCC_SHM_STATE_CLOSED, __ATOMIC_RELEASE);
+  munmap(addr, size);
+  shm_unlink(name);
+} /* }}} void cu_shm_destroy */
@@ -0,0 +1,63 @@
+/**
+ * collectd - src/utils/shm/shm.h
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_SHM_H
+#define UTILS_SHM_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Shared memory segments published by the daemon for local processes, see
+ * src/libcollectdclient/collectd/shm_format.h. Each segment starts with
+ * 32 bit "magic", "version" and "state" fields.
+ */
+
+/*
+ * NAME
+ *   cu_shm_create
+ *
+ * DESCRIPTION
+ *   Creates the shared memory segment `name' with `size' zeroed bytes,
+ *   accessible with `perms' by the group `group' (the daemon's group if NULL),
+ *   and maps it. A segment of the same name that starts with `magic', i.e. one
+ *   left behind by a daemon that did not shut down, is marked as closed and
+ *   replaced.
+ *
+ * RETURN VALUE
+ *   The address of the mapping, or NULL on error.
+ */
+void *cu_shm_create(char const *name, uint32_t magic, size_t size, int perms,
+                    char const *group);
+
+/*
+ * NAME
+ *   cu_shm_destroy
+ *
+ * DESCRIPTION
+ *   Marks the segment mapped at `addr' as closed, so that readers let go of it,
+ *   unmaps it and removes `name'.
+ */
+void cu_shm_destroy(char const *name, void *addr, size_t size);
+
+#endif /* UTILS_SHM_H */
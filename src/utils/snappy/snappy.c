@@ -0,0 +1,249 @@
+/**
+ * collectd - src/utils/snappy/snappy.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "utils/snappy/snappy.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+/* The input is compressed in blocks of this size, so that offsets of copies
+ * fit into two bytes and positions into the hash table's entries. */
+#define SNAPPY_BLOCK_SIZE 65536
+
+#define SNAPPY_HASH_BITS 14
+
+#define SNAPPY_TAG_LITERAL 0
+#define SNAPPY_TAG_COPY1 1
+#define SNAPPY_TAG_COPY2 2
+#define SNAPPY_TAG_COPY4 3
+
+static uint32_t load32(uint8_t const *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint32_t hash32(uint32_t v) {
+  return (v * 0x1e35a7bd) >> (32 - SNAPPY_HASH_BITS);
+}
+
+static uint8_t *emit_literal(uint8_t *op, uint8_t const *p, size_t len) {
+  size_t n = len - 1;
+
+  if (n < 60) {
+    *op++ = (uint8_t)(SNAPPY_TAG_LITERAL | (n << 2));
+  } else {
+    uint8_t *tag = op++;
+    size_t bytes = 0;
+    while (n > 0) {
+      *op++ = (uint8_t)(n & 0xff);
+      n >>= 8;
+      bytes++;
+    }
+    *tag = (uint8_t)(SNAPPY_TAG_LITERAL | ((59 + bytes) << 2));
+  }
+
+  memcpy(op, p, len);
+  return op + len;
+}
+
+/* `len' is at most 64. */
+static uint8_t *emit_copy_upto64(uint8_t *op, size_t offset, size_t len) {
+  if ((len >= 4) && (len < 12) && (offset < 2048)) {
+    *op++ = (uint8_t)(SNAPPY_TAG_COPY1 | ((len - 4) << 2) |
+                      ((offset >> 8) << 5));
+    *op++ = (uint8_t)(offset & 0xff);
+  } else {
+    *op++ = (uint8_t)(SNAPPY_TAG_COPY2 | ((len - 1) << 2));
+    *op++ = (uint8_t)(offset & 0xff);
+    *op++ = (uint8_t)(offset >> 8);
+  }
+  return op;
+}
+
+static uint8_t *emit_copy(uint8_t *op, size_t offset, size_t len) {
+  /* Split long copies so that the last part has at least four bytes, which
+   * allows the short COPY1 form. */
+  while (len >= 68) {
+    op = emit_copy_upto64(op, offset, 64);
+    len -= 64;
+  }
+  if (len > 64) {
+    op = emit_copy_upto64(op, offset, 60);
+    len -= 60;
+  }
+  return emit_copy_upto64(op, offset, len);
+}
+
+static uint8_t *compress_block(uint8_t *op, uint8_t const *in, size_t len,
+                               uint16_t *table) {
+  size_t ip = 0;
+  size_t next_emit = 0;
+  size_t skip = 32;
+
+  memset(table, 0, sizeof(*table) << SNAPPY_HASH_BITS);
+
+  while (ip + 4 <= len) {
+    uint32_t v = load32(in + ip);
+    uint32_t h = hash32(v);
+    size_t candidate = table[h];
+    table[h] = (uint16_t)ip;
+
+    if ((candidate >= ip) || (load32(in + candidate) != v)) {
+      /* Skip faster through data that does not compress. */
+      ip += skip++ >> 5;
+      continue;
+    }
+
+    if (next_emit < ip)
+      op = emit_literal(op, in + next_emit, ip - next_emit);
+
+    size_t match = 4;
+    while ((ip + match < len) && (in[candidate + match] == in[ip + match]))
+      match++;
+
+    op = emit_copy(op, ip - candidate, match);
+    ip += match;
+    next_emit = ip;
+    skip = 32;
+
+    if (ip >= 1 && ip + 3 <= len) {
+      uint32_t prev = load32(in + ip - 1);
+      table[hash32(prev)] = (uint16_t)(ip - 1);
+    }
+  }
+
+  if (next_emit < len)
+    op = emit_literal(op, in + next_emit, len - next_emit);
+  return op;
+}
+
+size_t snappy_max_compressed_length(size_t len) {
+  return 32 + len + len / 6;
+}
+
+size_t snappy_compress(void const *in, size_t in_len, void *out) {
+  uint8_t const *ip = in;
+  uint8_t *op = out;
+  uint16_t table[1 << SNAPPY_HASH_BITS];
+
+  /* Uncompressed length as a varint. */
+  size_t n = in_len;
+  while (n >= 0x80) {
+    *op++ = (uint8_t)(n | 0x80);
+    n >>= 7;
+  }
+  *op++ = (uint8_t)n;
+
+  for (size_t pos = 0; pos < in_len; pos += SNAPPY_BLOCK_SIZE) {
+    size_t len = in_len - pos;
+    if (len > SNAPPY_BLOCK_SIZE)
+      len = SNAPPY_BLOCK_SIZE;
+    op = compress_block(op, ip + pos, len, table);
+  }
+
+  return (size_t)(op - (uint8_t *)out);
+}
+
+int snappy_uncompress(void const *in, size_t in_len, void *out,
+                      size_t out_size, size_t *ret_len) {
+  uint8_t const *ip = in;
+  uint8_t const *end = ip + in_len;
+  uint8_t *op = out;
+
+  uint64_t len = 0;
+  for (int shift = 0;; shift += 7) {
+    if ((ip == end) || (shift > 28))
+      return EINVAL;
+    len |= (uint64_t)(*ip & 0x7f) << shift;
+    if ((*ip++ & 0x80) == 0)
+      break;
+  }
+  if (len > UINT32_MAX)
+    return EINVAL;
+  if (len > out_size)
+    return ENOBUFS;
+
+  size_t pos = 0;
+  while (ip < end) {
+    uint8_t tag = *ip++;
+    size_t n;
+    size_t offset = 0;
+
+    switch (tag & 3) {
+    case SNAPPY_TAG_LITERAL:
+      n = tag >> 2;
+      if (n >= 60) {
+        size_t bytes = n - 59;
+        if ((size_t)(end - ip) < bytes)
+          return EINVAL;
+        n = 0;
+        for (size_t i = 0; i < bytes; i++)
+          n |= (size_t)ip[i] << (8 * i);
+        ip += bytes;
+      }
+      n++;
+      if (((size_t)(end - ip) < n) || (len - pos < n))
+        return EINVAL;
+      memcpy(op + pos, ip, n);
+      ip += n;
+      pos += n;
+      continue;
+    case SNAPPY_TAG_COPY1:
+      if (ip == end)
+        return EINVAL;
+      n = 4 + ((tag >> 2) & 7);
+      offset = ((size_t)(tag >> 5) << 8) | *ip++;
+      break;
+    case SNAPPY_TAG_COPY2:
+      if (end - ip < 2)
+        return EINVAL;
+      n = 1 + (tag >> 2);
+      offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+      ip += 2;
+      break;
+    default: /* SNAPPY_TAG_COPY4 */
+      if (end - ip < 4)
+        return EINVAL;
+      n = 1 + (tag >> 2);
+      offset = (size_t)ip[0] | ((size_t)ip[1] << 8) | ((size_t)ip[2] << 16) |
+               ((size_t)ip[3] << 24);
+      ip += 4;
+      break;
+    }
+
+    if ((offset == 0) || (offset > pos) || (len - pos < n))
+      return EINVAL;
+    /* Copies may overlap their own output, so go byte by byte. */
+    for (size_t i = 0; i < n; i++)
+      op[pos + i] = op[pos - offset + i];
+    pos += n;
+  }
+
+  if (pos != len)
+    return EINVAL;
+
+  *ret_len = (size_t)len;
+  return 0;
+}
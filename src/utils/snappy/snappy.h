@@ -0,0 +1,66 @@
+/**
+ * collectd - src/utils/snappy/snappy.h
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_SNAPPY_H
+#define UTILS_SNAPPY_H 1
+
+#include <stddef.h>
+
+/*
+ * Snappy compression in the raw block format (no framing), as required by
+ * protocols such as the Prometheus remote write protocol. See
+ * <https://github.com/google/snappy/blob/main/format_description.txt>.
+ */
+
+/* Returns the size of the buffer snappy_compress() needs for `len' bytes. */
+size_t snappy_max_compressed_length(size_t len);
+
+/*
+ * NAME
+ *   snappy_compress
+ *
+ * DESCRIPTION
+ *   Compresses `in_len' bytes from `in' into `out', which must have room for
+ *   snappy_max_compressed_length(in_len) bytes.
+ *
+ * RETURN VALUE
+ *   The number of bytes written to `out'.
+ */
+size_t snappy_compress(void const *in, size_t in_len, void *out);
+
+/*
+ * NAME
+ *   snappy_uncompress
+ *
+ * DESCRIPTION
+ *   Uncompresses `in' into `out', which has room for `out_size' bytes. The
+ *   uncompressed length is stored in `ret_len'.
+ *
+ * RETURN VALUE
+ *   Zero upon success, ENOBUFS if `out' is too small or EINVAL if `in' is
+ *   not valid.
+ */
+int snappy_uncompress(void const *in, size_t in_len, void *out,
+                      size_t out_size, size_t *ret_len);
+
+#endif /* UTILS_SNAPPY_H */
@@ -0,0 +1,133 @@
+/**
+ * collectd - src/utils/snappy/snappy_test.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/snappy/snappy.h"
+
+/* Compresses and uncompresses `in' and returns the compressed size, or zero
+ * if the round trip failed. */
+static size_t round_trip(uint8_t const *in, size_t in_len) {
+  size_t max = snappy_max_compressed_length(in_len);
+  uint8_t *compressed = malloc(max);
+  uint8_t *out = malloc(in_len + 1);
+  assert((compressed != NULL) && (out != NULL));
+
+  size_t len = snappy_compress(in, in_len, compressed);
+  size_t out_len = 0;
+  int status = snappy_uncompress(compressed, len, out, in_len, &out_len);
+
+  bool ok = (len <= max) && (status == 0) && (out_len == in_len) &&
+            (memcmp(in, out, in_len) == 0);
+  free(compressed);
+  free(out);
+  return ok ? len : 0;
+}
+
+DEF_TEST(decode) {
+  /* "abc", followed by a copy of eight bytes at offset three: the copy
+   * overlaps its own output. */
+  uint8_t const in[] = {0x0b, 0x08, 'a', 'b', 'c', 0x11, 0x03};
+  char out[16] = {0};
+  size_t len = 0;
+
+  EXPECT_EQ_INT(0, snappy_uncompress(in, sizeof(in), out, sizeof(out), &len));
+  EXPECT_EQ_UINT64(11, len);
+  EXPECT_EQ_STR("abcabcabcab", out);
+
+  /* too small an output buffer */
+  EXPECT_EQ_INT(ENOBUFS, snappy_uncompress(in, sizeof(in), out, 10, &len));
+  /* truncated input */
+  EXPECT_EQ_INT(EINVAL,
+                snappy_uncompress(in, sizeof(in) - 1, out, sizeof(out), &len));
+  /* copy from before the start of the output */
+  uint8_t const bad_offset[] = {0x0b, 0x08, 'a', 'b', 'c', 0x11, 0x04};
+  EXPECT_EQ_INT(EINVAL, snappy_uncompress(bad_offset, sizeof(bad_offset), out,
+                                          sizeof(out), &len));
+  /* more output than announced */
+  uint8_t const too_long[] = {0x02, 0x08, 'a', 'b', 'c'};
+  EXPECT_EQ_INT(EINVAL, snappy_uncompress(too_long, sizeof(too_long), out,
+                                          sizeof(out), &len));
+
+  return 0;
+}
+
+DEF_TEST(empty) {
+  uint8_t out[8];
+  EXPECT_EQ_UINT64(1, snappy_compress("", 0, out));
+  EXPECT_EQ_INT(0, out[0]);
+
+  size_t len = 1;
+  EXPECT_EQ_INT(0, snappy_uncompress(out, 1, NULL, 0, &len));
+  EXPECT_EQ_UINT64(0, len);
+
+  return 0;
+}
+
+DEF_TEST(round_trip) {
+  size_t const size = 3 * 65536 + 1234;
+  uint8_t *data = malloc(size);
+  CHECK_NOT_NULL(data);
+
+  /* short inputs, including ones too short to have matches */
+  for (size_t i = 0; i < 64; i++)
+    data[i] = (uint8_t)('a' + i % 3);
+  for (size_t len = 1; len <= 64; len++)
+    OK(round_trip(data, len) != 0);
+
+  /* repetitive input spanning several blocks compresses well */
+  for (size_t i = 0; i < size; i++)
+    data[i] = (uint8_t)("collectd_cpu_total{cpu=\"0\"}"[i % 27]);
+  size_t len = round_trip(data, size);
+  OK(len != 0);
+  OK(len < size / 10);
+
+  /* so do long runs, which need long and overlapping copies */
+  memset(data, 'x', size);
+  OK(round_trip(data, size) != 0);
+
+  /* random input does not compress, but stays within the limit */
+  uint32_t state = 42;
+  for (size_t i = 0; i < size; i++) {
+    state = state * 1103515245 + 12345;
+    data[i] = (uint8_t)(state >> 16);
+  }
+  OK(round_trip(data, size) != 0);
+
+  /* mixed input */
+  for (size_t i = 0; i < size; i += 97)
+    memcpy(data + i, "__name__instancetype", (size - i < 20) ? size - i : 20);
+  OK(round_trip(data, size) != 0);
+
+  free(data);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(decode);
+  RUN_TEST(empty);
+  RUN_TEST(round_trip);
+
+  END_TEST;
+}
@@ -0,0 +1,522 @@
+/**
+ * collectd - src/utils/spool/spool.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "utils/common/common.h"
+#include "utils/spool/spool.h"
+
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+/* Every record starts with this header and is padded to a multiple of eight
+ * bytes. Consuming a record overwrites its magic with SPOOL_MAGIC_DONE through
+ * the mapping of the oldest segment. */
+#define SPOOL_MAGIC_VALID 0x53504f4cU /* "SPOL" */
+#define SPOOL_MAGIC_DONE 0x444f4e45U  /* "DONE" */
+
+#define SPOOL_SEGMENT_SIZE_MIN 65536
+#define SPOOL_SUFFIX ".spool"
+
+typedef struct {
+  uint32_t magic;
+  uint32_t len;
+} spool_header_t;
+
+#define SPOOL_RECORD_SIZE(len)                                                 \
+  (sizeof(spool_header_t) + (((uint64_t)(len) + 7) & ~((uint64_t)7)))
+
+typedef struct {
+  uint64_t seq;
+  uint64_t size;
+  uint64_t records; /* not consumed yet */
+} spool_segment_t;
+
+struct c_spool_s {
+  pthread_mutex_t lock;
+
+  char *dir;
+  uint64_t size_max;
+  uint64_t segment_size;
+
+  /* Oldest first. If tail_fd is valid, the last segment is being appended
+   * to. */
+  spool_segment_t *segments;
+  size_t segments_num;
+  uint64_t next_seq;
+  int tail_fd;
+
+  /* Mapping of segments[0], which records are read from. */
+  int head_fd;
+  uint8_t *head_map;
+  size_t head_map_len;
+  uint64_t head_offset;
+
+  uint64_t size;
+  uint64_t records;
+  uint64_t dropped;
+};
+
+static void spool_segment_path(c_spool_t *s, uint64_t seq, char *buffer,
+                               size_t buffer_size) {
+  snprintf(buffer, buffer_size, "%s/%016" PRIx64 SPOOL_SUFFIX, s->dir, seq);
+} /* void spool_segment_path */
+
+static void spool_head_unmap(c_spool_t *s) {
+  if (s->head_map != NULL)
+    munmap(s->head_map, s->head_map_len);
+  s->head_map = NULL;
+  s->head_map_len = 0;
+
+  if (s->head_fd >= 0)
+    close(s->head_fd);
+  s->head_fd = -1;
+} /* void spool_head_unmap */
+
+/* spool_head_map maps segments[0], remapping it if it has grown. */
+static int spool_head_map(c_spool_t *s) {
+  spool_segment_t *seg = s->segments;
+
+  if ((s->head_map != NULL) && (s->head_map_len == seg->size))
+    return 0;
+
+  if (s->head_fd < 0) {
+    char path[PATH_MAX];
+    spool_segment_path(s, seg->seq, path, sizeof(path));
+    s->head_fd = open(path, O_RDWR | O_CLOEXEC);
+    if (s->head_fd < 0)
+      return errno;
+  }
+
+  if (s->head_map != NULL)
+    munmap(s->head_map, s->head_map_len);
+  s->head_map = NULL;
+  s->head_map_len = 0;
+
+  if (seg->size == 0)
+    return 0;
+
+  void *map = mmap(NULL, (size_t)seg->size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED, s->head_fd, 0);
+  if (map == MAP_FAILED)
+    return errno;
+
+  s->head_map = map;
+  s->head_map_len = (size_t)seg->size;
+  return 0;
+} /* int spool_head_map */
+
+/* spool_segment_remove deletes the oldest segment. Its records that have not
+ * been consumed yet are counted as dropped. */
+static void spool_segment_remove(c_spool_t *s) {
+  spool_segment_t *seg = s->segments;
+
+  spool_head_unmap(s);
+  s->head_offset = 0;
+
+  if (s->segments_num == 1) {
+    if (s->tail_fd >= 0)
+      close(s->tail_fd);
+    s->tail_fd = -1;
+  }
+
+  char path[PATH_MAX];
+  spool_segment_path(s, seg->seq, path, sizeof(path));
+  if ((unlink(path) != 0) && (errno != ENOENT))
+    WARNING("spool: unlink(%s) failed: %s", path, STRERRNO);
+
+  s->size -= seg->size;
+  s->records -= seg->records;
+  s->dropped += seg->records;
+
+  memmove(s->segments, s->segments + 1,
+          (s->segments_num - 1) * sizeof(*s->segments));
+  s->segments_num--;
+} /* void spool_segment_remove */
+
+/* spool_segment_load counts the records of a segment left over from a
+ * previous run and truncates a partially written record at its end. */
+static int spool_segment_load(c_spool_t *s, spool_segment_t *seg) {
+  char path[PATH_MAX];
+  spool_segment_path(s, seg->seq, path, sizeof(path));
+
+  int fd = open(path, O_RDWR | O_CLOEXEC);
+  if (fd < 0)
+    return errno;
+
+  struct stat statbuf;
+  if (fstat(fd, &statbuf) != 0) {
+    int status = errno;
+    close(fd);
+    return status;
+  }
+
+  uint64_t size = (uint64_t)statbuf.st_size;
+  uint64_t offset = 0;
+  seg->records = 0;
+
+  if (size > 0) {
+    uint8_t *map = mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+      int status = errno;
+      close(fd);
+      return status;
+    }
+
+    while (offset + sizeof(spool_header_t) <= size) {
+      spool_header_t hdr;
+      memcpy(&hdr, map + offset, sizeof(hdr));
+      if (((hdr.magic != SPOOL_MAGIC_VALID) &&
+           (hdr.magic != SPOOL_MAGIC_DONE)) ||
+          (offset + SPOOL_RECORD_SIZE(hdr.len) > size))
+        break;
+
+      if (hdr.magic == SPOOL_MAGIC_VALID)
+        seg->records++;
+      offset += SPOOL_RECORD_SIZE(hdr.len);
+    }
+    munmap(map, (size_t)size);
+  }
+
+  if (offset != size) {
+    WARNING("spool: Discarding %" PRIu64 " bytes at the end of \"%s\".",
+            size - offset, path);
+    if (ftruncate(fd, (off_t)offset) != 0)
+      WARNING("spool: ftruncate(%s) failed: %s", path, STRERRNO);
+  }
+  close(fd);
+
+  seg->size = offset;
+  return 0;
+} /* int spool_segment_load */
+
+static int spool_seq_compare(void const *a, void const *b) {
+  uint64_t seq_a = ((spool_segment_t const *)a)->seq;
+  uint64_t seq_b = ((spool_segment_t const *)b)->seq;
+  return (seq_a > seq_b) - (seq_a < seq_b);
+} /* int spool_seq_compare */
+
+static int spool_load(c_spool_t *s) {
+  DIR *dh = opendir(s->dir);
+  if (dh == NULL)
+    return errno;
+
+  struct dirent *de;
+  while ((de = readdir(dh)) != NULL) {
+    char *end = NULL;
+    errno = 0;
+    uint64_t seq = (uint64_t)strtoull(de->d_name, &end, 16);
+    if ((errno != 0) || (end != de->d_name + 16) ||
+        (strcmp(end, SPOOL_SUFFIX) != 0))
+      continue;
+
+    spool_segment_t *tmp =
+        realloc(s->segments, (s->segments_num + 1) * sizeof(*s->segments));
+    if (tmp == NULL) {
+      closedir(dh);
+      return ENOMEM;
+    }
+    s->segments = tmp;
+    s->segments[s->segments_num] = (spool_segment_t){.seq = seq};
+    s->segments_num++;
+  }
+  closedir(dh);
+
+  if (s->segments_num > 0)
+    qsort(s->segments, s->segments_num, sizeof(*s->segments),
+          spool_seq_compare);
+
+  for (size_t i = 0; i < s->segments_num; i++) {
+    int status = spool_segment_load(s, s->segments + i);
+    if (status != 0) {
+      ERROR("spool: Loading segment %016" PRIx64 " failed: %s",
+            s->segments[i].seq, STRERROR(status));
+      return status;
+    }
+    s->size += s->segments[i].size;
+    s->records += s->segments[i].records;
+  }
+
+  if (s->segments_num > 0)
+    s->next_seq = s->segments[s->segments_num - 1].seq + 1;
+
+  /* Segments without records are only taking up space. */
+  while ((s->segments_num > 0) && (s->segments[0].records == 0))
+    spool_segment_remove(s);
+
+  return 0;
+} /* int spool_load */
+
+/* spool_segment_start opens a new segment for appending. */
+static int spool_segment_start(c_spool_t *s) {
+  spool_segment_t *tmp =
+      realloc(s->segments, (s->segments_num + 1) * sizeof(*s->segments));
+  if (tmp == NULL)
+    return ENOMEM;
+  s->segments = tmp;
+
+  if (s->tail_fd >= 0)
+    close(s->tail_fd);
+  s->tail_fd = -1;
+
+  char path[PATH_MAX];
+  spool_segment_path(s, s->next_seq, path, sizeof(path));
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+                0600);
+  if (fd < 0)
+    return errno;
+
+  s->tail_fd = fd;
+  s->segments[s->segments_num] = (spool_segment_t){.seq = s->next_seq};
+  s->segments_num++;
+  s->next_seq++;
+  return 0;
+} /* int spool_segment_start */
+
+c_spool_t *c_spool_create(char const *dir, uint64_t size_max,
+                          uint64_t segment_size) {
+  if ((dir == NULL) || (size_max == 0))
+    return NULL;
+
+  /* The trailing slash tells check_create_dir() that the last component is a
+   * directory, too. */
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/", dir);
+  if (check_create_dir(path) != 0) {
+    ERROR("spool: Creating directory \"%s\" failed.", dir);
+    return NULL;
+  }
+
+  c_spool_t *s = calloc(1, sizeof(*s));
+  if (s == NULL)
+    return NULL;
+
+  s->dir = strdup(dir);
+  if (s->dir == NULL) {
+    sfree(s);
+    return NULL;
+  }
+
+  s->size_max = size_max;
+  s->segment_size = segment_size;
+  if (s->segment_size == 0)
+    s->segment_size = size_max / 8;
+  if (s->segment_size < SPOOL_SEGMENT_SIZE_MIN)
+    s->segment_size = SPOOL_SEGMENT_SIZE_MIN;
+
+  s->tail_fd = -1;
+  s->head_fd = -1;
+  pthread_mutex_init(&s->lock, NULL);
+
+  int status = spool_load(s);
+  if (status != 0) {
+    ERROR("spool: Reading spool directory \"%s\" failed: %s", dir,
+          STRERROR(status));
+    c_spool_destroy(s);
+    return NULL;
+  }
+
+  return s;
+} /* c_spool_t *c_spool_create */
+
+void c_spool_destroy(c_spool_t *s) {
+  if (s == NULL)
+    return;
+
+  c_spool_sync(s);
+
+  spool_head_unmap(s);
+  if (s->tail_fd >= 0)
+    close(s->tail_fd);
+
+  pthread_mutex_destroy(&s->lock);
+  sfree(s->segments);
+  sfree(s->dir);
+  sfree(s);
+} /* void c_spool_destroy */
+
+int c_spool_append(c_spool_t *s, void const *data, size_t len) {
+  uint64_t record_size = SPOOL_RECORD_SIZE(len);
+  if ((len > UINT32_MAX) || (record_size > s->size_max))
+    return EMSGSIZE;
+
+  pthread_mutex_lock(&s->lock);
+
+  while ((s->segments_num > 0) && (s->size + record_size > s->size_max))
+    spool_segment_remove(s);
+
+  spool_segment_t *tail =
+      (s->tail_fd >= 0) ? s->segments + (s->segments_num - 1) : NULL;
+  if ((tail == NULL) ||
+      ((tail->size > 0) && (tail->size + record_size > s->segment_size))) {
+    int status = spool_segment_start(s);
+    if (status != 0) {
+      pthread_mutex_unlock(&s->lock);
+      return status;
+    }
+    tail = s->segments + (s->segments_num - 1);
+  }
+
+  spool_header_t hdr = {.magic = SPOOL_MAGIC_VALID, .len = (uint32_t)len};
+  uint8_t pad[8] = {0};
+  struct iovec iov[3] = {
+      {.iov_base = &hdr, .iov_len = sizeof(hdr)},
+      {.iov_base = (void *)data, .iov_len = len},
+      {.iov_base = pad, .iov_len = record_size - sizeof(hdr) - len},
+  };
+
+  ssize_t status = writev(s->tail_fd, iov, STATIC_ARRAY_SIZE(iov));
+  if (status != (ssize_t)record_size) {
+    int err = (status < 0) ? errno : EIO;
+    /* Don't leave a partial record behind. */
+    if (ftruncate(s->tail_fd, (off_t)tail->size) != 0)
+      WARNING("spool: ftruncate failed: %s", STRERRNO);
+    pthread_mutex_unlock(&s->lock);
+    return err;
+  }
+
+  tail->size += record_size;
+  tail->records++;
+  s->size += record_size;
+  s->records++;
+
+  pthread_mutex_unlock(&s->lock);
+  return 0;
+} /* int c_spool_append */
+
+int c_spool_peek(c_spool_t *s, void **ret_data, size_t *ret_len,
+                 c_spool_pos_t *ret_pos) {
+  pthread_mutex_lock(&s->lock);
+
+  while (s->segments_num > 0) {
+    spool_segment_t *seg = s->segments;
+
+    int status = spool_head_map(s);
+    if (status != 0) {
+      pthread_mutex_unlock(&s->lock);
+      return status;
+    }
+
+    while (s->head_offset + sizeof(spool_header_t) <= seg->size) {
+      spool_header_t hdr;
+      memcpy(&hdr, s->head_map + s->head_offset, sizeof(hdr));
+
+      if (hdr.magic == SPOOL_MAGIC_VALID) {
+        void *data = malloc(hdr.len + 1);
+        if (data == NULL) {
+          pthread_mutex_unlock(&s->lock);
+          return ENOMEM;
+        }
+        memcpy(data, s->head_map + s->head_offset + sizeof(hdr), hdr.len);
+        ((char *)data)[hdr.len] = 0;
+
+        *ret_data = data;
+        *ret_len = hdr.len;
+        *ret_pos = (c_spool_pos_t){
+            .segment = seg->seq,
+            .offset = s->head_offset,
+        };
+        pthread_mutex_unlock(&s->lock);
+        return 0;
+      }
+
+      s->head_offset += SPOOL_RECORD_SIZE(hdr.len);
+    }
+
+    /* All records of this segment have been consumed. If it was the segment
+     * being appended to, the next append starts a new one. */
+    spool_segment_remove(s);
+  }
+
+  pthread_mutex_unlock(&s->lock);
+  return ENOENT;
+} /* int c_spool_peek */
+
+int c_spool_consume(c_spool_t *s, c_spool_pos_t pos) {
+  pthread_mutex_lock(&s->lock);
+
+  if ((s->segments_num == 0) || (s->segments[0].seq != pos.segment) ||
+      (s->head_map == NULL) ||
+      (pos.offset + sizeof(spool_header_t) > s->head_map_len)) {
+    pthread_mutex_unlock(&s->lock);
+    return ENOENT;
+  }
+
+  spool_header_t hdr;
+  memcpy(&hdr, s->head_map + pos.offset, sizeof(hdr));
+  if (hdr.magic != SPOOL_MAGIC_VALID) {
+    pthread_mutex_unlock(&s->lock);
+    return ENOENT;
+  }
+
+  hdr.magic = SPOOL_MAGIC_DONE;
+  memcpy(s->head_map + pos.offset, &hdr, sizeof(hdr));
+
+  s->segments[0].records--;
+  s->records--;
+  if (s->head_offset <= pos.offset)
+    s->head_offset = pos.offset + SPOOL_RECORD_SIZE(hdr.len);
+
+  /* Don't keep a drained segment around until the next peek. */
+  if (s->segments[0].records == 0)
+    spool_segment_remove(s);
+
+  pthread_mutex_unlock(&s->lock);
+  return 0;
+} /* int c_spool_consume */
+
+int c_spool_sync(c_spool_t *s) {
+  int status = 0;
+
+  pthread_mutex_lock(&s->lock);
+  if ((s->head_map != NULL) &&
+      (msync(s->head_map, s->head_map_len, MS_SYNC) != 0))
+    status = errno;
+  if ((s->tail_fd >= 0) && (fdatasync(s->tail_fd) != 0))
+    status = errno;
+  pthread_mutex_unlock(&s->lock);
+
+  return status;
+} /* int c_spool_sync */
+
+uint64_t c_spool_records(c_spool_t *s) {
+  pthread_mutex_lock(&s->lock);
+  uint64_t records = s->records;
+  pthread_mutex_unlock(&s->lock);
+  return records;
+} /* uint64_t c_spool_records */
+
+uint64_t c_spool_size(c_spool_t *s) {
+  pthread_mutex_lock(&s->lock);
+  uint64_t size = s->size;
+  pthread_mutex_unlock(&s->lock);
+  return size;
+} /* uint64_t c_spool_size */
+
+uint64_t c_spool_dropped(c_spool_t *s) {
+  pthread_mutex_lock(&s->lock);
+  uint64_t dropped = s->dropped;
+  pthread_mutex_unlock(&s->lock);
+  return dropped;
+} /* uint64_t c_spool_dropped */
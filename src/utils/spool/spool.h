@@ -0,0 +1,143 @@
+/**
+ * collectd - src/utils/spool/spool.h
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_SPOOL_H
+#define UTILS_SPOOL_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Append-only, disk-backed FIFO of opaque records. Records are appended to
+ * segment files in a directory and read back, oldest first, from a shared
+ * memory mapping of the oldest segment. Reading a record copies it; it is only
+ * marked as consumed, in place, once the caller has dealt with it, so records
+ * survive a restart until they have been consumed. When the spool would grow
+ * beyond its size limit, its oldest segments are dropped. All functions are
+ * thread-safe.
+ */
+struct c_spool_s;
+typedef struct c_spool_s c_spool_t;
+
+/* Position of a record, as returned by c_spool_peek(). */
+typedef struct {
+  uint64_t segment;
+  uint64_t offset;
+} c_spool_pos_t;
+
+/*
+ * NAME
+ *   c_spool_create
+ *
+ * DESCRIPTION
+ *   Opens the spool in directory `dir', creating the directory if necessary.
+ *   Records left over by a previous run are picked up; a partially written
+ *   record at the end of a segment is discarded.
+ *
+ * PARAMETERS
+ *   `dir'           Directory holding the segment files. It should not be
+ *                   used for anything else.
+ *   `size_max'      Maximum size of all segments in bytes.
+ *   `segment_size'  Size in bytes after which a new segment is started. Zero
+ *                   selects an eighth of `size_max', but at least 64 KiB.
+ *
+ * RETURN VALUE
+ *   A c_spool_t-pointer upon success or NULL upon failure.
+ */
+c_spool_t *c_spool_create(char const *dir, uint64_t size_max,
+                          uint64_t segment_size);
+
+/*
+ * NAME
+ *   c_spool_destroy
+ *
+ * DESCRIPTION
+ *   Closes the spool. Records not consumed yet stay on disk.
+ */
+void c_spool_destroy(c_spool_t *s);
+
+/*
+ * NAME
+ *   c_spool_append
+ *
+ * DESCRIPTION
+ *   Appends a copy of `data' to the spool, dropping the oldest segments if
+ *   the size limit would be exceeded otherwise.
+ *
+ * RETURN VALUE
+ *   Zero upon success, EMSGSIZE if the record is larger than the size limit or
+ *   an errno value if writing the segment failed.
+ */
+int c_spool_append(c_spool_t *s, void const *data, size_t len);
+
+/*
+ * NAME
+ *   c_spool_peek
+ *
+ * DESCRIPTION
+ *   Returns a copy of the oldest record not consumed yet. The caller must
+ *   free `*ret_data' and pass `*ret_pos' to c_spool_consume() once the record
+ *   has been dealt with.
+ *
+ * RETURN VALUE
+ *   Zero upon success, ENOENT if the spool is empty or an errno value upon
+ *   failure.
+ */
+int c_spool_peek(c_spool_t *s, void **ret_data, size_t *ret_len,
+                 c_spool_pos_t *ret_pos);
+
+/*
+ * NAME
+ *   c_spool_consume
+ *
+ * DESCRIPTION
+ *   Marks the record at `pos' as consumed.
+ *
+ * RETURN VALUE
+ *   Zero upon success, ENOENT if the record is no longer the oldest one, e.g.
+ *   because its segment has been dropped in the meantime.
+ */
+int c_spool_consume(c_spool_t *s, c_spool_pos_t pos);
+
+/*
+ * NAME
+ *   c_spool_sync
+ *
+ * DESCRIPTION
+ *   Flushes appended records and consumed marks to disk.
+ */
+int c_spool_sync(c_spool_t *s);
+
+/*
+ * NAME
+ *   c_spool_records, c_spool_size, c_spool_dropped
+ *
+ * DESCRIPTION
+ *   Return the number of records not consumed yet, the size of all segments
+ *   in bytes and the number of records dropped because of the size limit.
+ */
+uint64_t c_spool_records(c_spool_t *s);
+uint64_t c_spool_size(c_spool_t *s);
+uint64_t c_spool_dropped(c_spool_t *s);
+
+#endif /* UTILS_SPOOL_H */
@@ -0,0 +1,202 @@
+/**
+ * collectd - src/utils/spool/spool_test.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/spool/spool.h"
+
+#include <dirent.h>
+
+static char spool_dir[] = "/tmp/spool_test.XXXXXX";
+
+static void remove_segments(void) {
+  DIR *dh = opendir(spool_dir);
+  if (dh == NULL)
+    return;
+
+  struct dirent *de;
+  while ((de = readdir(dh)) != NULL) {
+    char path[PATH_MAX];
+    if (de->d_name[0] == '.')
+      continue;
+    snprintf(path, sizeof(path), "%s/%s", spool_dir, de->d_name);
+    unlink(path);
+  }
+  closedir(dh);
+}
+
+static int pop(c_spool_t *s, char *buffer, size_t buffer_size) {
+  void *data = NULL;
+  size_t len = 0;
+  c_spool_pos_t pos;
+
+  int status = c_spool_peek(s, &data, &len, &pos);
+  if (status != 0)
+    return status;
+
+  snprintf(buffer, buffer_size, "%s", (char *)data);
+  free(data);
+  return c_spool_consume(s, pos);
+}
+
+DEF_TEST(simple) {
+  c_spool_t *s;
+  char buffer[64];
+
+  remove_segments();
+  CHECK_NOT_NULL(s = c_spool_create(spool_dir, 1 << 20, 0));
+  EXPECT_EQ_INT(ENOENT, pop(s, buffer, sizeof(buffer)));
+
+  for (int i = 0; i < 10; i++) {
+    snprintf(buffer, sizeof(buffer), "record %d", i);
+    CHECK_ZERO(c_spool_append(s, buffer, strlen(buffer)));
+  }
+  EXPECT_EQ_UINT64(10, c_spool_records(s));
+
+  /* peeking twice returns the same record until it is consumed */
+  void *data = NULL;
+  size_t len = 0;
+  c_spool_pos_t pos;
+  CHECK_ZERO(c_spool_peek(s, &data, &len, &pos));
+  free(data);
+  CHECK_ZERO(c_spool_peek(s, &data, &len, &pos));
+  EXPECT_EQ_STR("record 0", data);
+  EXPECT_EQ_UINT64(8, len);
+  free(data);
+  CHECK_ZERO(c_spool_consume(s, pos));
+  EXPECT_EQ_INT(ENOENT, c_spool_consume(s, pos));
+
+  for (int i = 1; i < 5; i++) {
+    char want[64];
+    snprintf(want, sizeof(want), "record %d", i);
+    CHECK_ZERO(pop(s, buffer, sizeof(buffer)));
+    EXPECT_EQ_STR(want, buffer);
+  }
+  EXPECT_EQ_UINT64(5, c_spool_records(s));
+  c_spool_destroy(s);
+
+  /* unconsumed records survive a restart */
+  CHECK_NOT_NULL(s = c_spool_create(spool_dir, 1 << 20, 0));
+  EXPECT_EQ_UINT64(5, c_spool_records(s));
+  for (int i = 5; i < 10; i++) {
+    char want[64];
+    snprintf(want, sizeof(want), "record %d", i);
+    CHECK_ZERO(pop(s, buffer, sizeof(buffer)));
+    EXPECT_EQ_STR(want, buffer);
+  }
+  EXPECT_EQ_INT(ENOENT, pop(s, buffer, sizeof(buffer)));
+  EXPECT_EQ_UINT64(0, c_spool_records(s));
+  EXPECT_EQ_UINT64(0, c_spool_size(s));
+  EXPECT_EQ_UINT64(0, c_spool_dropped(s));
+
+  c_spool_destroy(s);
+  return 0;
+}
+
+DEF_TEST(size_limit) {
+  c_spool_t *s;
+  char record[1000] = {0};
+
+  remove_segments();
+  /* four segments of 64 KiB */
+  CHECK_NOT_NULL(s = c_spool_create(spool_dir, 1 << 18, 1 << 16));
+  EXPECT_EQ_INT(EMSGSIZE, c_spool_append(s, record, 1 << 18));
+
+  for (int i = 0; i < 1000; i++) {
+    snprintf(record, sizeof(record), "%d", i);
+    CHECK_ZERO(c_spool_append(s, record, sizeof(record)));
+    OK(c_spool_size(s) <= (1 << 18));
+  }
+  OK(c_spool_dropped(s) > 0);
+  EXPECT_EQ_UINT64(1000, c_spool_records(s) + c_spool_dropped(s));
+
+  /* the newest records are kept */
+  char buffer[64];
+  int first = (int)c_spool_dropped(s);
+  for (int i = first; i < 1000; i++) {
+    char want[64];
+    snprintf(want, sizeof(want), "%d", i);
+    CHECK_ZERO(pop(s, buffer, sizeof(buffer)));
+    EXPECT_EQ_STR(want, buffer);
+  }
+  EXPECT_EQ_INT(ENOENT, pop(s, buffer, sizeof(buffer)));
+
+  c_spool_destroy(s);
+  return 0;
+}
+
+DEF_TEST(torn_record) {
+  c_spool_t *s;
+  char buffer[64];
+
+  remove_segments();
+  CHECK_NOT_NULL(s = c_spool_create(spool_dir, 1 << 20, 0));
+  CHECK_ZERO(c_spool_append(s, "first", 5));
+  CHECK_ZERO(c_spool_append(s, "second", 6));
+  c_spool_destroy(s);
+
+  /* cut the last record in half, as if writing it had been interrupted */
+  DIR *dh;
+  CHECK_NOT_NULL(dh = opendir(spool_dir));
+  struct dirent *de;
+  while ((de = readdir(dh)) != NULL) {
+    char path[PATH_MAX];
+    struct stat statbuf;
+    if (de->d_name[0] == '.')
+      continue;
+    snprintf(path, sizeof(path), "%s/%s", spool_dir, de->d_name);
+    CHECK_ZERO(stat(path, &statbuf));
+    CHECK_ZERO(truncate(path, statbuf.st_size - 4));
+  }
+  closedir(dh);
+
+  CHECK_NOT_NULL(s = c_spool_create(spool_dir, 1 << 20, 0));
+  EXPECT_EQ_UINT64(1, c_spool_records(s));
+  CHECK_ZERO(pop(s, buffer, sizeof(buffer)));
+  EXPECT_EQ_STR("first", buffer);
+
+  /* appending after the truncated record works */
+  CHECK_ZERO(c_spool_append(s, "third", 5));
+  CHECK_ZERO(pop(s, buffer, sizeof(buffer)));
+  EXPECT_EQ_STR("third", buffer);
+  EXPECT_EQ_INT(ENOENT, pop(s, buffer, sizeof(buffer)));
+
+  c_spool_destroy(s);
+  return 0;
+}
+
+int main(void) {
+  if (mkdtemp(spool_dir) == NULL) {
+    perror("mkdtemp");
+    return 1;
+  }
+
+  RUN_TEST(simple);
+  RUN_TEST(size_limit);
+  RUN_TEST(torn_record);
+
+  remove_segments();
+  rmdir(spool_dir);
+  END_TEST;
+}
@@ -0,0 +1,152 @@
+/**
+ * collectd - src/utils/strbuf/strbuf.c
+ * Copyright (C) 2026       collectd.org
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/strbuf/strbuf.h"
+
+#define STRBUF_MIN_SIZE 512
+
+strbuf_t *strbuf_create(void) {
+  strbuf_t *buf = calloc(1, sizeof(*buf));
+  return buf;
+} /* strbuf_t *strbuf_create */
+
+void strbuf_destroy(strbuf_t *buf) {
+  if (buf == NULL)
+    return;
+
+  STRBUF_DESTROY(*buf);
+  free(buf);
+} /* void strbuf_destroy */
+
+void strbuf_reset(strbuf_t *buf) {
+  buf->pos = 0;
+  if (buf->size > 0)
+    buf->ptr[0] = 0;
+} /* void strbuf_reset */
+
+int strbuf_reserve(strbuf_t *buf, size_t n) {
+  if (buf->pos + n < buf->size)
+    return 0;
+  if (buf->fixed)
+    return ENOMEM;
+
+  size_t new_size = (buf->size < STRBUF_MIN_SIZE) ? STRBUF_MIN_SIZE : buf->size;
+  while (buf->pos + n >= new_size)
+    new_size *= 2;
+
+  char *tmp = realloc(buf->ptr, new_size);
+  if (tmp == NULL)
+    return ENOMEM;
+  if (buf->size == 0)
+    tmp[0] = 0;
+
+  buf->ptr = tmp;
+  buf->size = new_size;
+  return 0;
+} /* int strbuf_reserve */
+
+void strbuf_truncate(strbuf_t *buf, size_t pos) {
+  if (pos >= buf->pos)
+    return;
+
+  buf->pos = pos;
+  buf->ptr[pos] = 0;
+} /* void strbuf_truncate */
+
+int strbuf_printn(strbuf_t *buf, char const *s, size_t n) {
+  if (strbuf_reserve(buf, n) != 0) {
+    if (!buf->fixed || (buf->size == 0))
+      return ENOMEM;
+
+    /* Copy what fits, like snprintf would. */
+    n = buf->size - 1 - buf->pos;
+    memcpy(buf->ptr + buf->pos, s, n);
+    buf->pos += n;
+    buf->ptr[buf->pos] = 0;
+    return ENOMEM;
+  }
+
+  memcpy(buf->ptr + buf->pos, s, n);
+  buf->pos += n;
+  buf->ptr[buf->pos] = 0;
+  return 0;
+} /* int strbuf_printn */
+
+int strbuf_print(strbuf_t *buf, char const *s) {
+  return strbuf_printn(buf, s, strlen(s));
+} /* int strbuf_print */
+
+int strbuf_printf(strbuf_t *buf, char const *format, ...) {
+  va_list ap;
+  int status;
+
+  /* Try with the space that is left first; most strings fit. */
+  size_t avail = (buf->size > buf->pos) ? buf->size - buf->pos : 0;
+  va_start(ap, format);
+  status = vsnprintf((avail > 0) ? buf->ptr + buf->pos : NULL, avail, format,
+                     ap);
+  va_end(ap);
+  if (status < 0)
+    return errno ? errno : EINVAL;
+
+  size_t len = (size_t)status;
+  if (len < avail) {
+    buf->pos += len;
+    return 0;
+  }
+
+  if (strbuf_reserve(buf, len) != 0) {
+    if (buf->fixed && (avail > 0)) {
+      /* vsnprintf() has written as much as fits. */
+      buf->pos = buf->size - 1;
+    }
+    return ENOMEM;
+  }
+
+  va_start(ap, format);
+  vsnprintf(buf->ptr + buf->pos, buf->size - buf->pos, format, ap);
+  va_end(ap);
+  buf->pos += len;
+  return 0;
+} /* int strbuf_printf */
+
+char *strbuf_release(strbuf_t *buf, size_t *ret_len, size_t *ret_size) {
+  char *ptr = buf->ptr;
+
+  if (ret_len != NULL)
+    *ret_len = buf->pos;
+  if (ret_size != NULL)
+    *ret_size = buf->size;
+
+  buf->ptr = NULL;
+  buf->pos = 0;
+  buf->size = 0;
+  return ptr;
+} /* char *strbuf_release */
@@ -0,0 +1,88 @@
+/**
+ * collectd - src/utils/strbuf/strbuf.h
+ * Copyright (C) 2026       collectd.org
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_STRBUF_H
+#define UTILS_STRBUF_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * String buffer used by the output formatters. A dynamic buffer grows as
+ * needed, so appending only fails if memory cannot be allocated. A fixed
+ * buffer wraps memory supplied by the caller and fails with ENOMEM when the
+ * data doesn't fit; its content is truncated then. In both cases `ptr' is
+ * always null-terminated (once something has been written) and `pos' is the
+ * length of the string.
+ *
+ * The members may be used directly, e.g. to hand the memory to a library
+ * without copying it; see strbuf_release().
+ */
+typedef struct {
+  char *ptr;
+  size_t pos;
+  size_t size;
+  bool fixed;
+} strbuf_t;
+
+/* Initializers for buffers on the stack. Dynamic buffers must be freed with
+ * STRBUF_DESTROY(). */
+#define STRBUF_CREATE ((strbuf_t){.ptr = NULL})
+#define STRBUF_CREATE_FIXED(buffer, buffer_size)                               \
+  ((strbuf_t){.ptr = (buffer), .size = (buffer_size), .fixed = true})
+#define STRBUF_DESTROY(buf)                                                    \
+  do {                                                                         \
+    if (!(buf).fixed)                                                          \
+      free((buf).ptr);                                                         \
+    (buf) = STRBUF_CREATE;                                                     \
+  } while (0)
+
+/* Allocates and frees a dynamic buffer on the heap. */
+strbuf_t *strbuf_create(void);
+void strbuf_destroy(strbuf_t *buf);
+
+/* Empties the buffer, keeping its memory. */
+void strbuf_reset(strbuf_t *buf);
+
+/* Appends data. All of them return zero on success and ENOMEM if the buffer
+ * is full (fixed buffers) or memory could not be allocated. */
+int strbuf_print(strbuf_t *buf, char const *s);
+int strbuf_printn(strbuf_t *buf, char const *s, size_t n);
+int strbuf_printf(strbuf_t *buf, char const *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/* Makes sure that at least "n" more bytes (plus the terminating null byte)
+ * fit into a dynamic buffer without reallocating. */
+int strbuf_reserve(strbuf_t *buf, size_t n);
+
+/* Truncates the string to "pos" bytes, e.g. to undo a partial append. */
+void strbuf_truncate(strbuf_t *buf, size_t pos);
+
+/* Takes the memory of a dynamic buffer, leaving it empty. The caller has to
+ * free the returned pointer; it may be NULL if nothing has been written. The
+ * length of the string is stored in "ret_len" and the size of the allocation
+ * in "ret_size", if they are not NULL. */
+char *strbuf_release(strbuf_t *buf, size_t *ret_len, size_t *ret_size);
+
+#endif /* UTILS_STRBUF_H */
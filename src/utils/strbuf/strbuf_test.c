@@ -0,0 +1,111 @@
+/**
+ * collectd - src/utils/strbuf/strbuf_test.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/strbuf/strbuf.h"
+
+DEF_TEST(dynamic) {
+  strbuf_t buf = STRBUF_CREATE;
+  char want[4096];
+
+  CHECK_ZERO(strbuf_print(&buf, "foo"));
+  CHECK_ZERO(strbuf_printf(&buf, "%s=%d", "bar", 42));
+  CHECK_ZERO(strbuf_printn(&buf, "bazqux", 3));
+  EXPECT_EQ_STR("foobar=42baz", buf.ptr);
+  EXPECT_EQ_UINT64(12, buf.pos);
+
+  /* grow well beyond the initial allocation */
+  strbuf_reset(&buf);
+  EXPECT_EQ_STR("", buf.ptr);
+  int status = 0;
+  for (size_t i = 0; i < sizeof(want) - 1; i++) {
+    want[i] = 'a' + (i % 26);
+    status |= strbuf_printf(&buf, "%c", want[i]);
+  }
+  EXPECT_EQ_INT(0, status);
+  want[sizeof(want) - 1] = 0;
+  EXPECT_EQ_STR(want, buf.ptr);
+  EXPECT_EQ_UINT64(sizeof(want) - 1, buf.pos);
+
+  strbuf_truncate(&buf, 3);
+  EXPECT_EQ_STR("abc", buf.ptr);
+
+  size_t len = 0;
+  char *ptr = strbuf_release(&buf, &len, NULL);
+  EXPECT_EQ_STR("abc", ptr);
+  EXPECT_EQ_UINT64(3, len);
+  EXPECT_EQ_UINT64(0, buf.size);
+  free(ptr);
+
+  /* the buffer is still usable after releasing its memory */
+  CHECK_ZERO(strbuf_print(&buf, "x"));
+  EXPECT_EQ_STR("x", buf.ptr);
+
+  STRBUF_DESTROY(buf);
+  return 0;
+}
+
+DEF_TEST(fixed) {
+  char mem[8];
+  strbuf_t buf = STRBUF_CREATE_FIXED(mem, sizeof(mem));
+
+  CHECK_ZERO(strbuf_print(&buf, "1234"));
+  EXPECT_EQ_INT(ENOMEM, strbuf_print(&buf, "5678"));
+  EXPECT_EQ_STR("1234567", mem);
+  EXPECT_EQ_UINT64(7, buf.pos);
+
+  strbuf_reset(&buf);
+  CHECK_ZERO(strbuf_printf(&buf, "%d", 1234567));
+  EXPECT_EQ_STR("1234567", mem);
+
+  strbuf_reset(&buf);
+  EXPECT_EQ_INT(ENOMEM, strbuf_printf(&buf, "%d", 12345678));
+  EXPECT_EQ_STR("1234567", mem);
+  EXPECT_EQ_UINT64(7, buf.pos);
+
+  /* destroying a fixed buffer must not free the memory */
+  STRBUF_DESTROY(buf);
+  return 0;
+}
+
+DEF_TEST(heap) {
+  strbuf_t *buf;
+
+  CHECK_NOT_NULL(buf = strbuf_create());
+  CHECK_ZERO(strbuf_print(buf, "hello, "));
+  CHECK_ZERO(strbuf_print(buf, "world"));
+  EXPECT_EQ_STR("hello, world", buf->ptr);
+
+  strbuf_destroy(buf);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(dynamic);
+  RUN_TEST(fixed);
+  RUN_TEST(heap);
+
+  END_TEST;
+}
@@ -35,12 +35,95 @@
 #include "utils/common/common.h"
 #include "utils/tail/tail.h"
 
+#if HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+
+/* Events which indicate that the file may have been rotated. */
+#define CU_TAIL_ROTATE_EVENTS                                                  \
+  (IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED)
+#endif
+
+/* Size of the read-ahead buffer. Data is read in chunks of up to this size
+ * and split into lines in place. */
+#ifndef CU_TAIL_BUFFER_SIZE
+#define CU_TAIL_BUFFER_SIZE 65536
+#endif
+
 struct cu_tail_s {
   char *file;
-  FILE *fh;
+  int fd;
   struct stat stat;
+  /* Number of bytes read from fd, i.e. the file offset. */
+  off_t offset;
+
+  char *buffer;
+  size_t buffer_pos;
+  size_t buffer_fill;
+
+#if HAVE_SYS_INOTIFY_H
+  int inotify_fd;
+  int watch;
+  /* Events seen since the file has been checked for rotation. */
+  uint32_t events;
+#endif
 };
 
+#if HAVE_SYS_INOTIFY_H
+/* cu_tail_watch (re-)registers the inotify watch for the currently opened
+ * file. Without a watch, the file is checked for rotation on every EOF. */
+static void cu_tail_watch(cu_tail_t *obj) {
+  if (obj->inotify_fd < 0)
+    return;
+
+  if (obj->watch >= 0) {
+    inotify_rm_watch(obj->inotify_fd, obj->watch);
+    obj->watch = -1;
+  }
+
+  obj->watch = inotify_add_watch(obj->inotify_fd, obj->file,
+                                 IN_MODIFY | CU_TAIL_ROTATE_EVENTS);
+  if (obj->watch < 0)
+    P_WARNING("utils_tail: inotify_add_watch (%s) failed: %s", obj->file,
+              STRERRNO);
+  obj->events = 0;
+} /* void cu_tail_watch */
+
+/* cu_tail_events collects the pending inotify events. If no watch is
+ * active, all events are assumed to have happened. */
+static uint32_t cu_tail_events(cu_tail_t *obj) {
+  if ((obj->inotify_fd < 0) || (obj->watch < 0))
+    return IN_MODIFY | CU_TAIL_ROTATE_EVENTS;
+
+  char buffer[4096]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+  while (42) {
+    ssize_t status = read(obj->inotify_fd, buffer, sizeof(buffer));
+    if (status <= 0)
+      break;
+
+    for (char *ptr = buffer; ptr < buffer + status;) {
+      struct inotify_event *ev = (void *)ptr;
+
+      if (ev->wd == obj->watch)
+        obj->events |= ev->mask;
+      ptr += sizeof(*ev) + ev->len;
+    }
+  }
+
+  /* A watch removed by the kernel doesn't report any further events. */
+  if (obj->events & IN_IGNORED)
+    obj->watch = -1;
+
+  return obj->events;
+} /* uint32_t cu_tail_events */
+#endif /* HAVE_SYS_INOTIFY_H */
+
+static void cu_tail_close(cu_tail_t *obj) {
+  if (obj->fd >= 0)
+    close(obj->fd);
+  obj->fd = -1;
+} /* void cu_tail_close */
+
 static int cu_tail_reopen(cu_tail_t *obj, bool force_rewind) {
   int seek_end = 0;
   struct stat stat_buf = {0};
@@ -52,17 +135,19 @@ static int cu_tail_reopen(cu_tail_t *obj, bool force_rewind) {
   }
 
   /* The file is already open.. */
-  if ((obj->fh != NULL) && (stat_buf.st_ino == obj->stat.st_ino)) {
+  if ((obj->fd >= 0) && (stat_buf.st_ino == obj->stat.st_ino) &&
+      (stat_buf.st_dev == obj->stat.st_dev)) {
     /* Seek to the beginning if file was truncated */
-    if (stat_buf.st_size < obj->stat.st_size) {
+    if (stat_buf.st_size < obj->offset) {
       P_INFO("utils_tail: File `%s' was truncated.", obj->file);
-      status = fseek(obj->fh, 0, SEEK_SET);
-      if (status != 0) {
-        P_ERROR("utils_tail: fseek (%s) failed: %s", obj->file, STRERRNO);
-        fclose(obj->fh);
-        obj->fh = NULL;
+      if (lseek(obj->fd, 0, SEEK_SET) == (off_t)-1) {
+        P_ERROR("utils_tail: lseek (%s) failed: %s", obj->file, STRERRNO);
+        cu_tail_close(obj);
         return -1;
       }
+      obj->offset = 0;
+      memcpy(&obj->stat, &stat_buf, sizeof(struct stat));
+      return 0;
     }
     memcpy(&obj->stat, &stat_buf, sizeof(struct stat));
     return 1;
@@ -74,29 +159,172 @@ static int cu_tail_reopen(cu_tail_t *obj, bool force_rewind) {
   if ((obj->stat.st_ino == 0) || (obj->stat.st_ino == stat_buf.st_ino))
     seek_end = !force_rewind;
 
-  FILE *fh = fopen(obj->file, "r");
-  if (fh == NULL) {
-    P_ERROR("utils_tail: fopen (%s) failed: %s", obj->file, STRERRNO);
+  int fd = open(obj->file, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    P_ERROR("utils_tail: open (%s) failed: %s", obj->file, STRERRNO);
     return -1;
   }
 
+  off_t offset = 0;
   if (seek_end != 0) {
-    status = fseek(fh, 0, SEEK_END);
-    if (status != 0) {
-      P_ERROR("utils_tail: fseek (%s) failed: %s", obj->file, STRERRNO);
-      fclose(fh);
+    offset = lseek(fd, 0, SEEK_END);
+    if (offset == (off_t)-1) {
+      P_ERROR("utils_tail: lseek (%s) failed: %s", obj->file, STRERRNO);
+      close(fd);
       return -1;
     }
   }
 
-  if (obj->fh != NULL)
-    fclose(obj->fh);
-  obj->fh = fh;
+  cu_tail_close(obj);
+  obj->fd = fd;
+  obj->offset = offset;
   memcpy(&obj->stat, &stat_buf, sizeof(struct stat));
 
+#if HAVE_SYS_INOTIFY_H
+  cu_tail_watch(obj);
+#endif
+
   return 0;
 } /* int cu_tail_reopen */
 
+/* cu_tail_check is called when the end of the file has been reached. It
+ * returns zero if the file has been re-opened or rewound and there may be
+ * more to read, greater than zero if there is nothing more to read and less
+ * than zero on error. */
+static int cu_tail_check(cu_tail_t *obj, bool force_rewind) {
+#if HAVE_SYS_INOTIFY_H
+  uint32_t events = cu_tail_events(obj);
+
+  /* Nothing happened to the file: no need to look at it. */
+  if (events == 0)
+    return 1;
+
+  /* The file has been written to, but not moved or deleted. Only a
+   * truncation needs to be handled. */
+  if ((events & CU_TAIL_ROTATE_EVENTS) == 0) {
+    struct stat stat_buf = {0};
+
+    obj->events = 0;
+    if ((fstat(obj->fd, &stat_buf) != 0) || (stat_buf.st_size >= obj->offset))
+      return 1;
+  }
+#endif
+
+  int status = cu_tail_reopen(obj, force_rewind);
+
+#if HAVE_SYS_INOTIFY_H
+  /* Keep checking until the file at the path is the one being read. */
+  if ((status > 0) && (obj->watch >= 0) &&
+      ((obj->events & (IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED)) == 0))
+    obj->events = 0;
+#endif
+
+  return status;
+} /* int cu_tail_check */
+
+/* cu_tail_fill reads more data into the buffer. Returns the number of bytes
+ * read, zero on EOF and less than zero on error. */
+static ssize_t cu_tail_fill(cu_tail_t *obj) {
+  if (obj->buffer_pos > 0) {
+    memmove(obj->buffer, obj->buffer + obj->buffer_pos,
+            obj->buffer_fill - obj->buffer_pos);
+    obj->buffer_fill -= obj->buffer_pos;
+    obj->buffer_pos = 0;
+  }
+
+  /* Leave room for the terminating null byte. */
+  size_t avail = CU_TAIL_BUFFER_SIZE - 1 - obj->buffer_fill;
+  if (avail == 0)
+    return 0;
+
+  while (42) {
+    ssize_t status = read(obj->fd, obj->buffer + obj->buffer_fill, avail);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      P_ERROR("utils_tail: read (%s) failed: %s", obj->file, STRERRNO);
+      return -1;
+    }
+
+    obj->buffer_fill += (size_t)status;
+    obj->offset += (off_t)status;
+    return status;
+  }
+} /* ssize_t cu_tail_fill */
+
+/* cu_tail_next_line returns the next line, including the newline character,
+ * as a pointer into the internal buffer. Lines longer than "max_len" are
+ * split. A partial line at the end of the file is only returned once the
+ * rest of it has been written or the file is rotated. "*ret_len" is set to
+ * zero on EOF. Returns 0 when successful and non-zero otherwise. */
+static int cu_tail_next_line(cu_tail_t *obj, size_t max_len, bool force_rewind,
+                             char **ret_line, size_t *ret_len) {
+  int status;
+
+  if (obj->fd < 0) {
+    status = cu_tail_reopen(obj, force_rewind);
+    if (status < 0)
+      return status;
+  }
+  assert(obj->fd >= 0);
+
+  if (max_len > CU_TAIL_BUFFER_SIZE - 1)
+    max_len = CU_TAIL_BUFFER_SIZE - 1;
+
+  while (42) {
+    char *start = obj->buffer + obj->buffer_pos;
+    size_t avail = obj->buffer_fill - obj->buffer_pos;
+    size_t len = 0;
+
+    char *newline = memchr(start, '\n', (avail < max_len) ? avail : max_len);
+    if (newline != NULL)
+      len = (size_t)(newline - start) + 1;
+    else if (avail >= max_len)
+      len = max_len;
+
+    if (len > 0) {
+      obj->buffer_pos += len;
+      *ret_line = start;
+      *ret_len = len;
+      return 0;
+    }
+
+    ssize_t read_status = cu_tail_fill(obj);
+    if (read_status > 0)
+      continue;
+
+    if (read_status < 0) {
+      /* Force `cu_tail_reopen' to reopen the file on the next call.. */
+      cu_tail_close(obj);
+      return -1;
+    }
+
+    /* EOF -> check if the file was moved away or truncated and reopen /
+     * rewind it if so.. */
+    status = cu_tail_check(obj, force_rewind);
+    if (status < 0)
+      return status;
+
+    /* cu_tail_fill may have moved the data to the start of the buffer. */
+    start = obj->buffer + obj->buffer_pos;
+    avail = obj->buffer_fill - obj->buffer_pos;
+
+    if (status > 0) {
+      *ret_line = start;
+      *ret_len = 0;
+      return 0;
+    }
+
+    /* The old file is done with: return its incomplete last line. */
+    if (avail > 0) {
+      obj->buffer_pos += avail;
+      *ret_line = start;
+      *ret_len = avail;
+      return 0;
+    }
+  }
+} /* int cu_tail_next_line */
+
 cu_tail_t *cu_tail_create(const char *file) {
   cu_tail_t *obj;
 
@@ -105,19 +333,33 @@ cu_tail_t *cu_tail_create(const char *file) {
     return NULL;
 
   obj->file = strdup(file);
-  if (obj->file == NULL) {
+  obj->buffer = malloc(CU_TAIL_BUFFER_SIZE);
+  if ((obj->file == NULL) || (obj->buffer == NULL)) {
+    free(obj->file);
+    free(obj->buffer);
     free(obj);
     return NULL;
   }
 
-  obj->fh = NULL;
+  obj->fd = -1;
+
+#if HAVE_SYS_INOTIFY_H
+  obj->watch = -1;
+  obj->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (obj->inotify_fd < 0)
+    P_WARNING("utils_tail: inotify_init1 failed: %s", STRERRNO);
+#endif
 
   return obj;
 } /* cu_tail_t *cu_tail_create */
 
 int cu_tail_destroy(cu_tail_t *obj) {
-  if (obj->fh != NULL)
-    fclose(obj->fh);
+  cu_tail_close(obj);
+#if HAVE_SYS_INOTIFY_H
+  if (obj->inotify_fd >= 0)
+    close(obj->inotify_fd);
+#endif
+  free(obj->buffer);
   free(obj->file);
   free(obj);
 
@@ -125,64 +367,21 @@ int cu_tail_destroy(cu_tail_t *obj) {
 } /* int cu_tail_destroy */
 
 int cu_tail_readline(cu_tail_t *obj, char *buf, int buflen, bool force_rewind) {
-  int status;
+  char *line = NULL;
+  size_t len = 0;
 
   if (buflen < 1) {
     ERROR("utils_tail: cu_tail_readline: buflen too small: %i bytes.", buflen);
     return -1;
   }
 
-  if (obj->fh == NULL) {
-    status = cu_tail_reopen(obj, force_rewind);
-    if (status < 0)
-      return status;
-  }
-  assert(obj->fh != NULL);
-
-  /* Try to read from the filehandle. If that succeeds, everything appears to
-   * be fine and we can return. */
-  clearerr(obj->fh);
-  if (fgets(buf, buflen, obj->fh) != NULL) {
-    buf[buflen - 1] = '\0';
-    return 0;
-  }
-
-  /* Check if we encountered an error */
-  if (ferror(obj->fh) != 0) {
-    /* Jupp, error. Force `cu_tail_reopen' to reopen the file.. */
-    fclose(obj->fh);
-    obj->fh = NULL;
-  }
-  /* else: eof -> check if the file was moved away and reopen the new file if
-   * so.. */
-
-  status = cu_tail_reopen(obj, force_rewind);
-  /* error -> return with error */
-  if (status < 0)
+  int status = cu_tail_next_line(obj, (size_t)buflen - 1, force_rewind,
+                                 &line, &len);
+  if (status != 0)
     return status;
-  /* file end reached and file not reopened -> nothing more to read */
-  else if (status > 0) {
-    buf[0] = 0;
-    return 0;
-  }
-
-  /* If we get here: file was re-opened and there may be more to read.. Let's
-   * try again. */
-  if (fgets(buf, buflen, obj->fh) != NULL) {
-    buf[buflen - 1] = '\0';
-    return 0;
-  }
-
-  if (ferror(obj->fh) != 0) {
-    WARNING("utils_tail: fgets (%s) returned an error: %s", obj->file,
-            STRERRNO);
-    fclose(obj->fh);
-    obj->fh = NULL;
-    return -1;
-  }
 
-  /* EOf, well, apparently the new file is empty.. */
-  buf[0] = 0;
+  memcpy(buf, line, len);
+  buf[len] = '\0';
   return 0;
 } /* int cu_tail_readline */
 
@@ -190,10 +389,17 @@ int cu_tail_read(cu_tail_t *obj, char *buf, int buflen, tailfunc_t *callback,
                  void *data, bool force_rewind) {
   int status;
 
+  if (buflen < 2) {
+    ERROR("utils_tail: cu_tail_read: buflen too small: %i bytes.", buflen);
+    return -1;
+  }
+
   while (42) {
-    size_t len;
+    char *line = NULL;
+    size_t len = 0;
 
-    status = cu_tail_readline(obj, buf, buflen, force_rewind);
+    status = cu_tail_next_line(obj, (size_t)buflen - 1, force_rewind, &line,
+                               &len);
     if (status != 0) {
       ERROR("utils_tail: cu_tail_read: cu_tail_readline "
             "failed.");
@@ -201,18 +407,21 @@ int cu_tail_read(cu_tail_t *obj, char *buf, int buflen, tailfunc_t *callback,
     }
 
     /* check for EOF */
-    if (buf[0] == 0)
+    if (len == 0)
       break;
 
-    len = strlen(buf);
-    while (len > 0) {
-      if (buf[len - 1] != '\n')
-        break;
-      buf[len - 1] = '\0';
-      len--;
+    /* Lines are passed to the callback in place. Lines without a newline
+     * may be followed by more data, so they are copied to "buf" to be
+     * null-terminated. */
+    if (line[len - 1] == '\n') {
+      line[len - 1] = '\0';
+    } else {
+      memcpy(buf, line, len);
+      buf[len] = '\0';
+      line = buf;
     }
 
-    status = callback(data, buf, buflen);
+    status = callback(data, line, (int)len);
     if (status != 0) {
       ERROR("utils_tail: cu_tail_read: callback returned "
             "status %i.",
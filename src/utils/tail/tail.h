@@ -69,16 +69,26 @@ int cu_tail_destroy(cu_tail_t *obj);
  *
  * You can check if the EOF condition is reached by looking at the buffer: If
  * the length of the string stored in the buffer is zero, EOF occurred.
- * Otherwise at least the newline character will be in the buffer.
+ * Otherwise at least the newline character will be in the buffer. An
+ * incomplete line at the end of the file is held back until it is completed
+ * or the file is rotated.
+ *
+ * The file is read in large chunks. Where inotify is available, the file is
+ * only checked for rotation and truncation after an event has been
+ * reported for it.
  *
  * Returns 0 when successful and non-zero otherwise.
  */
 int cu_tail_readline(cu_tail_t *obj, char *buf, int buflen, bool force_rewind);
 
 /*
- * cu_tail_readline
+ * cu_tail_read
  *
- * Reads from the file until eof condition or an error is encountered.
+ * Reads from the file until eof condition or an error is encountered and
+ * calls `callback' for each line, without the newline character. Lines are
+ * usually passed in place, pointing into the tail object's buffer, and are
+ * only valid during the callback. `buf' is used for lines that need to be
+ * copied; `buflen' limits the line length as for cu_tail_readline.
  *
  * Returns 0 when successful and non-zero otherwise.
  */
@@ -0,0 +1,177 @@
+/**
+ * collectd - src/utils/tail/tail_test.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/common/common.h"
+#include "utils/tail/tail.h"
+
+static char tail_dir[] = "/tmp/tail_test.XXXXXX";
+static char tail_file[64];
+static char tail_rotated[64];
+
+static int append(char const *data) {
+  FILE *fh = fopen(tail_file, "a");
+  if (fh == NULL)
+    return -1;
+  fputs(data, fh);
+  return fclose(fh);
+}
+
+static int truncate_to(char const *data) {
+  FILE *fh = fopen(tail_file, "w");
+  if (fh == NULL)
+    return -1;
+  fputs(data, fh);
+  return fclose(fh);
+}
+
+typedef struct {
+  char lines[8][64];
+  int num;
+} collect_t;
+
+static int collect(void *data, char *buf, int buflen) {
+  collect_t *c = data;
+
+  if (c->num >= 8)
+    return -1;
+  sstrncpy(c->lines[c->num++], buf, sizeof(c->lines[0]));
+  return 0;
+}
+
+DEF_TEST(readline) {
+  char buf[64];
+
+  CHECK_ZERO(truncate_to("before\n"));
+
+  cu_tail_t *t = cu_tail_create(tail_file);
+  CHECK_NOT_NULL(t);
+
+  /* The first open seeks to the end of the file. */
+  CHECK_ZERO(cu_tail_readline(t, buf, sizeof(buf), false));
+  EXPECT_EQ_STR("", buf);
+
+  CHECK_ZERO(append("one\ntwo\n"));
+  CHECK_ZERO(cu_tail_readline(t, buf, sizeof(buf), false));
+  EXPECT_EQ_STR("one\n", buf);
+  CHECK_ZERO(cu_tail_readline(t, buf, sizeof(buf), false));
+  EXPECT_EQ_STR("two\n", buf);
+  CHECK_ZERO(cu_tail_readline(t, buf, sizeof(buf), false));
+  EXPECT_EQ_STR("", buf);
+
+  /* Incomplete lines are held back until they are completed. */
+  CHECK_ZERO(append("thr"));
+  CHECK_ZERO(cu_tail_readline(t, buf, sizeof(buf), false));
+  EXPECT_EQ_STR("", buf);
+  CHECK_ZERO(append("ee\n"));
+  CHECK_ZERO(cu_tail_readline(t, buf, sizeof(buf), false));
+  EXPECT_EQ_STR("three\n", buf);
+
+  /* Long lines are split at buflen - 1 characters. */
+  CHECK_ZERO(append("0123456789\n"));
+  CHECK_ZERO(cu_tail_readline(t, buf, 5, false));
+  EXPECT_EQ_STR("0123", buf);
+  CHECK_ZERO(cu_tail_readline(t, buf, 5, false));
+  EXPECT_EQ_STR("4567", buf);
+  CHECK_ZERO(cu_tail_readline(t, buf, 5, false));
+  EXPECT_EQ_STR("89\n", buf);
+
+  cu_tail_destroy(t);
+  return 0;
+}
+
+DEF_TEST(truncate) {
+  collect_t c = {0};
+  char buf[64];
+
+  CHECK_ZERO(truncate_to(""));
+
+  cu_tail_t *t = cu_tail_create(tail_file);
+  CHECK_NOT_NULL(t);
+
+  CHECK_ZERO(cu_tail_read(t, buf, sizeof(buf), collect, &c, false));
+  CHECK_ZERO(append("a somewhat longer first line\n"));
+  CHECK_ZERO(cu_tail_read(t, buf, sizeof(buf), collect, &c, false));
+  EXPECT_EQ_INT(1, c.num);
+  EXPECT_EQ_STR("a somewhat longer first line", c.lines[0]);
+
+  CHECK_ZERO(truncate_to("short\n"));
+  CHECK_ZERO(cu_tail_read(t, buf, sizeof(buf), collect, &c, false));
+  EXPECT_EQ_INT(2, c.num);
+  EXPECT_EQ_STR("short", c.lines[1]);
+
+  cu_tail_destroy(t);
+  return 0;
+}
+
+DEF_TEST(rotate) {
+  collect_t c = {0};
+  char buf[64];
+
+  CHECK_ZERO(truncate_to(""));
+
+  cu_tail_t *t = cu_tail_create(tail_file);
+  CHECK_NOT_NULL(t);
+
+  CHECK_ZERO(cu_tail_read(t, buf, sizeof(buf), collect, &c, false));
+  CHECK_ZERO(append("old\nincomplete"));
+  CHECK_ZERO(cu_tail_read(t, buf, sizeof(buf), collect, &c, false));
+  EXPECT_EQ_INT(1, c.num);
+  EXPECT_EQ_STR("old", c.lines[0]);
+
+  /* Rotation: the old file's incomplete line is returned, then the new
+   * file is read from the beginning. */
+  CHECK_ZERO(rename(tail_file, tail_rotated));
+  CHECK_ZERO(append("new\n"));
+  CHECK_ZERO(cu_tail_read(t, buf, sizeof(buf), collect, &c, false));
+  EXPECT_EQ_INT(3, c.num);
+  EXPECT_EQ_STR("incomplete", c.lines[1]);
+  EXPECT_EQ_STR("new", c.lines[2]);
+
+  /* Nothing changed: nothing is returned. */
+  CHECK_ZERO(cu_tail_read(t, buf, sizeof(buf), collect, &c, false));
+  EXPECT_EQ_INT(3, c.num);
+
+  cu_tail_destroy(t);
+  unlink(tail_rotated);
+  return 0;
+}
+
+int main(void) {
+  if (mkdtemp(tail_dir) == NULL) {
+    perror("mkdtemp");
+    return 1;
+  }
+  snprintf(tail_file, sizeof(tail_file), "%s/file", tail_dir);
+  snprintf(tail_rotated, sizeof(tail_rotated), "%s/file.1", tail_dir);
+
+  RUN_TEST(readline);
+  RUN_TEST(truncate);
+  RUN_TEST(rotate);
+
+  unlink(tail_file);
+  rmdir(tail_dir);
+  END_TEST;
+}
@@ -150,6 +150,90 @@ static int get_taskstats(ts_t *ts, uint32_t tgid,
   return 0;
 }
 
+/* TS_BATCH_SIZE is the maximum number of TASKSTATS_CMD_GET requests sent in
+ * a single datagram. */
+#define TS_BATCH_SIZE 32
+
+/* get_taskstats_batch sends one TASKSTATS_CMD_GET request per tgid in a single
+ * datagram and collects the replies. The replies are matched to the requests
+ * by sequence number. */
+static int get_taskstats_batch(ts_t *ts, uint32_t const *tgids, size_t num,
+                               struct taskstats *ret_taskstats,
+                               int *ret_status) {
+  char buffer[MNL_SOCKET_BUFFER_SIZE];
+  size_t buffer_fill = 0;
+  uint32_t seq_base = ts->seq;
+
+  assert(num <= TS_BATCH_SIZE);
+  ts->seq += (uint32_t)num;
+
+  for (size_t i = 0; i < num; i++) {
+    struct nlmsghdr *nlh = mnl_nlmsg_put_header(buffer + buffer_fill);
+    *nlh = (struct nlmsghdr){
+        .nlmsg_len = nlh->nlmsg_len,
+        .nlmsg_type = ts->genl_id_taskstats,
+        .nlmsg_flags = NLM_F_REQUEST,
+        .nlmsg_seq = seq_base + (uint32_t)i,
+        .nlmsg_pid = ts->pid,
+    };
+
+    struct genlmsghdr *genh = mnl_nlmsg_put_extra_header(nlh, sizeof(*genh));
+    *genh = (struct genlmsghdr){
+        .cmd = TASKSTATS_CMD_GET,
+        .version = TASKSTATS_GENL_VERSION,
+    };
+
+    mnl_attr_put_u32(nlh, TASKSTATS_CMD_ATTR_TGID, tgids[i]);
+
+    buffer_fill += nlh->nlmsg_len;
+    ret_status[i] = EINPROGRESS;
+  }
+
+  if (mnl_socket_sendto(ts->nl, buffer, buffer_fill) < 0) {
+    int status = errno;
+    ERROR("utils_taskstats: mnl_socket_sendto() = %s", STRERROR(status));
+    return status;
+  }
+
+  size_t pending = num;
+  while (pending > 0) {
+    int status = mnl_socket_recvfrom(ts->nl, buffer, sizeof(buffer));
+    if (status < 0) {
+      status = errno;
+      ERROR("utils_taskstats: mnl_socket_recvfrom() = %s", STRERROR(status));
+      return status;
+    } else if (status == 0) {
+      ERROR("utils_taskstats: mnl_socket_recvfrom() = 0");
+      return ECONNABORTED;
+    }
+
+    int len = status;
+    for (struct nlmsghdr *nlh = (void *)buffer; mnl_nlmsg_ok(nlh, len);
+         nlh = mnl_nlmsg_next(nlh, &len)) {
+      /* Replies to earlier, abandoned requests are simply dropped. */
+      size_t idx = (size_t)(nlh->nlmsg_seq - seq_base);
+      if ((nlh->nlmsg_pid != ts->port_id) || (idx >= num) ||
+          (ret_status[idx] != EINPROGRESS)) {
+        continue;
+      }
+
+      if (nlh->nlmsg_type == NLMSG_ERROR) {
+        struct nlmsgerr *nlerr = mnl_nlmsg_get_payload(nlh);
+        ret_status[idx] = nlerr->error * (-1);
+      } else if (mnl_attr_parse(nlh, sizeof(struct genlmsghdr),
+                                get_taskstats_attr_cb,
+                                ret_taskstats + idx) < MNL_CB_STOP) {
+        ret_status[idx] = EPROTO;
+      } else {
+        ret_status[idx] = 0;
+      }
+      pending--;
+    }
+  }
+
+  return 0;
+}
+
 static int get_family_id_attr_cb(const struct nlattr *attr, void *data) {
   uint16_t type = mnl_attr_get_type(attr);
   if (type != CTRL_ATTR_FAMILY_ID) {
@@ -305,3 +389,39 @@ int ts_delay_by_tgid(ts_t *ts, uint32_t tgid, ts_delay_t *out) {
   };
   return 0;
 }
+
+int ts_delay_by_tgids(ts_t *ts, uint32_t const *tgids, size_t num,
+                      ts_delay_t *out, int *ret_status) {
+  if ((ts == NULL) || ((num > 0) && ((tgids == NULL) || (out == NULL) ||
+                                     (ret_status == NULL)))) {
+    return EINVAL;
+  }
+
+  struct taskstats raw[TS_BATCH_SIZE];
+
+  for (size_t offset = 0; offset < num; offset += TS_BATCH_SIZE) {
+    size_t batch_num = num - offset;
+    if (batch_num > TS_BATCH_SIZE)
+      batch_num = TS_BATCH_SIZE;
+
+    memset(raw, 0, sizeof(raw));
+    int status = get_taskstats_batch(ts, tgids + offset, batch_num, raw,
+                                     ret_status + offset);
+    if (status != 0) {
+      for (size_t i = offset; i < num; i++)
+        ret_status[i] = status;
+      return status;
+    }
+
+    for (size_t i = 0; i < batch_num; i++) {
+      out[offset + i] = (ts_delay_t){
+          .cpu_ns = raw[i].cpu_delay_total,
+          .blkio_ns = raw[i].blkio_delay_total,
+          .swapin_ns = raw[i].swapin_delay_total,
+          .freepages_ns = raw[i].freepages_delay_total,
+      };
+    }
+  }
+
+  return 0;
+}
@@ -44,4 +44,12 @@ void ts_destroy(ts_t *);
  * identified by tgid. Returns zero on success and an errno otherwise. */
 int ts_delay_by_tgid(ts_t *ts, uint32_t tgid, ts_delay_t *out);
 
+/* ts_delay_by_tgids returns Linux delay accounting information for "num"
+ * tasks. Requests are sent in batches, so that many tasks only cost a few
+ * round trips. ret_status[i] is set to zero if out[i] is valid and to an errno
+ * otherwise. Returns zero on success and an errno if communicating with the
+ * kernel failed. */
+int ts_delay_by_tgids(ts_t *ts, uint32_t const *tgids, size_t num,
+                      ts_delay_t *out, int *ret_status);
+
 #endif /* UTILS_TASKSTATS_H */
@@ -0,0 +1,996 @@
+/**
+ * collectd - src/utils/tcp_pool/tcp_pool.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+/* _GNU_SOURCE is needed in Linux to use pthread_setname_np */
+#define _GNU_SOURCE
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils/common/common.h"
+#include "utils/tcp_pool/tcp_pool.h"
+#include "utils_complain.h"
+#include "utils_random.h"
+
+#include <netdb.h>
+#include <poll.h>
+#include <sys/uio.h>
+
+/* Maximum number of buffers written with one writev(2) call. */
+#define TP_IOV_MAX 64
+
+#define TP_MIN_RECONNECT_INTERVAL TIME_T_TO_CDTIME_T(1)
+
+/* How long to keep trying to send the backlog when shutting down. */
+#define TP_SHUTDOWN_TIMEOUT TIME_T_TO_CDTIME_T(2)
+
+/* Number of points each server gets on the consistent hashing ring. */
+#define TP_RING_POINTS 160
+
+typedef struct tp_buffer_s {
+  struct tp_buffer_s *next;
+  size_t len;
+  size_t size;
+  char data[];
+} tp_buffer_t;
+
+/* All members but node and service belong to the I/O thread. */
+typedef struct {
+  char *node;
+  char *service;
+
+  struct addrinfo *ai_list;
+  struct addrinfo **addrs;
+  size_t addrs_num;
+  /* Time of the next lookup. With a zero resolve interval, "expired" is set
+   * instead once connecting to all addresses failed. */
+  cdtime_t expire;
+  bool expired;
+  c_complain_t complaint;
+} tp_server_t;
+
+/* One connection of the pool. fill is filled by the write threads and
+ * protected by send_lock. Full buffers are appended to the queue, which is
+ * protected by queue_lock like backlog_complaint. All other members belong to
+ * the I/O thread, except "down", which is accessed atomically. */
+typedef struct {
+  tp_server_t *server;
+
+  tp_buffer_t *fill;
+  cdtime_t fill_init_time;
+
+  tp_buffer_t *queue_head;
+  tp_buffer_t *queue_tail;
+  size_t queue_len;
+  c_complain_t backlog_complaint;
+
+  int fd;
+  bool connecting;
+  bool down;
+  cdtime_t last_connect_time;
+  cdtime_t connect_time;
+  c_complain_t complaint;
+
+  /* The server's address tried next and the number of addresses that failed
+   * in a row. */
+  size_t addr_next;
+  size_t addrs_failed;
+
+  /* Buffers taken off the queue and being written. The first sending_offset
+   * bytes of the first one have been written already. */
+  tp_buffer_t *sending;
+  size_t sending_num;
+  size_t sending_offset;
+} tp_conn_t;
+
+typedef struct {
+  uint64_t hash;
+  size_t server;
+} tp_ring_point_t;
+
+struct c_tcp_pool_s {
+  char *name;
+
+  tp_server_t *servers;
+  size_t servers_num;
+  tp_conn_t *conns;
+  size_t conns_num;
+  size_t conn_current;
+  size_t connections; /* per server */
+  tp_ring_point_t *ring;
+  size_t ring_num;
+
+  size_t buffer_size;
+  size_t backlog_size;
+  cdtime_t resolve_interval;
+  cdtime_t resolve_jitter;
+  cdtime_t reconnect_interval;
+  bool close_after_send;
+  bool udp;
+  bool quiet_send_errors;
+
+  pthread_mutex_t send_lock;
+
+  pthread_mutex_t queue_lock;
+  tp_buffer_t *idle;
+  size_t idle_num;
+
+  pthread_t thread;
+  bool thread_started;
+  bool stop;
+  int wake_fd[2];
+  struct pollfd *pollfds;
+};
+
+/* tp_buffer_get returns an empty buffer with room for at least size bytes.
+ * Buffers of the configured size are recycled. */
+static tp_buffer_t *tp_buffer_get(c_tcp_pool_t *p, size_t size) {
+  tp_buffer_t *b = NULL;
+
+  if (size <= p->buffer_size) {
+    size = p->buffer_size;
+
+    pthread_mutex_lock(&p->queue_lock);
+    b = p->idle;
+    if (b != NULL) {
+      p->idle = b->next;
+      p->idle_num--;
+    }
+    pthread_mutex_unlock(&p->queue_lock);
+  }
+
+  if (b == NULL) {
+    b = malloc(sizeof(*b) + size);
+    if (b == NULL)
+      return NULL;
+    b->size = size;
+  }
+
+  b->next = NULL;
+  b->len = 0;
+  return b;
+}
+
+/* tp_buffer_put_nolock returns a list of buffers to the idle list, keeping
+ * enough of them around to refill the pool without calling malloc(3). Must
+ * hold p->queue_lock when calling. */
+static void tp_buffer_put_nolock(c_tcp_pool_t *p, tp_buffer_t *b) {
+  while (b != NULL) {
+    tp_buffer_t *next = b->next;
+    if ((b->size == p->buffer_size) &&
+        (p->idle_num < TP_IOV_MAX * p->conns_num)) {
+      b->next = p->idle;
+      p->idle = b;
+      p->idle_num++;
+    } else {
+      sfree(b);
+    }
+    b = next;
+  }
+}
+
+static void tp_buffer_free(tp_buffer_t *b) {
+  while (b != NULL) {
+    tp_buffer_t *next = b->next;
+    sfree(b);
+    b = next;
+  }
+}
+
+/* tp_wake wakes up the I/O thread. */
+static void tp_wake(c_tcp_pool_t *p) {
+  if (write(p->wake_fd[1], "", 1) < 0 && errno != EAGAIN)
+    WARNING("%s plugin: Waking the I/O thread failed: %s", p->name,
+            STRERRNO);
+}
+
+/* tp_enqueue hands the connection's fill buffer to the I/O thread. If the
+ * backlog is full, e.g. because the server is down or too slow, the oldest
+ * buffers are dropped. Must hold p->send_lock when calling. */
+static void tp_enqueue(c_tcp_pool_t *p, tp_conn_t *conn) {
+  tp_buffer_t *b = conn->fill;
+  conn->fill = NULL;
+  if ((b == NULL) || (b->len == 0)) {
+    pthread_mutex_lock(&p->queue_lock);
+    tp_buffer_put_nolock(p, b);
+    pthread_mutex_unlock(&p->queue_lock);
+    return;
+  }
+
+  pthread_mutex_lock(&p->queue_lock);
+  if (conn->queue_tail == NULL)
+    conn->queue_head = b;
+  else
+    conn->queue_tail->next = b;
+  conn->queue_tail = b;
+  conn->queue_len += b->len;
+
+  size_t dropped = 0;
+  while ((conn->queue_len > p->backlog_size) && (conn->queue_head != b)) {
+    tp_buffer_t *old = conn->queue_head;
+    conn->queue_head = old->next;
+    conn->queue_len -= old->len;
+    dropped += old->len;
+
+    old->next = NULL;
+    tp_buffer_put_nolock(p, old);
+  }
+  if (dropped > 0)
+    c_complain(LOG_WARNING, &conn->backlog_complaint,
+               "%s plugin: The backlog for %s:%s is full. "
+               "Dropping the oldest data.",
+               p->name, conn->server->node, conn->server->service);
+  pthread_mutex_unlock(&p->queue_lock);
+
+  tp_wake(p);
+}
+
+/* tp_next_conn moves on to the next connection that is not down. If all of
+ * them are, the next one is used anyway so data gets queued. Must hold
+ * p->send_lock when calling. */
+static void tp_next_conn(c_tcp_pool_t *p) {
+  for (size_t i = 1; i <= p->conns_num; i++) {
+    size_t next = (p->conn_current + i) % p->conns_num;
+    if (!__atomic_load_n(&p->conns[next].down, __ATOMIC_RELAXED)) {
+      p->conn_current = next;
+      return;
+    }
+  }
+  p->conn_current = (p->conn_current + 1) % p->conns_num;
+}
+
+/* tp_hash_mix scrambles the bits of an FNV-1a hash, which are poorly
+ * distributed for similar strings such as the ring points' names. This is
+ * the finalizer of MurmurHash3. */
+static uint64_t tp_hash_mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+static int tp_ring_point_compare(void const *a, void const *b) {
+  uint64_t ha = ((tp_ring_point_t const *)a)->hash;
+  uint64_t hb = ((tp_ring_point_t const *)b)->hash;
+  return (ha > hb) - (ha < hb);
+}
+
+/* tp_ring_create places TP_RING_POINTS points of each server on the
+ * consistent hashing ring. */
+static int tp_ring_create(c_tcp_pool_t *p) {
+  p->ring_num = p->servers_num * TP_RING_POINTS;
+  p->ring = calloc(p->ring_num, sizeof(*p->ring));
+  if (p->ring == NULL)
+    return ENOMEM;
+
+  for (size_t i = 0; i < p->servers_num; i++) {
+    for (size_t j = 0; j < TP_RING_POINTS; j++) {
+      char point[1024];
+      snprintf(point, sizeof(point), "%s:%s#%" PRIsz, p->servers[i].node,
+               p->servers[i].service, j);
+      p->ring[i * TP_RING_POINTS + j] = (tp_ring_point_t){
+          .hash = tp_hash_mix(hash_name(point)),
+          .server = i,
+      };
+    }
+  }
+  qsort(p->ring, p->ring_num, sizeof(*p->ring), tp_ring_point_compare);
+
+  return 0;
+}
+
+/* tp_ring_lookup returns the server responsible for hash. */
+static size_t tp_ring_lookup(c_tcp_pool_t *p, uint64_t hash) {
+  size_t lo = 0;
+  size_t hi = p->ring_num;
+
+  /* Find the first point at or after hash, wrapping around at the end. */
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (p->ring[mid].hash < hash)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == p->ring_num)
+    lo = 0;
+
+  return p->ring[lo].server;
+}
+
+/*
+ * I/O thread
+ */
+/* tp_server_resolve looks up the server's addresses unless the cached ones
+ * are still valid. Returns zero if there are addresses to connect to. */
+static int tp_server_resolve(c_tcp_pool_t *p, tp_server_t *srv,
+                             cdtime_t now) {
+  if (srv->addrs_num > 0) {
+    if (!srv->expired &&
+        ((p->resolve_interval == 0) || (now < srv->expire)))
+      return 0;
+  } else if (now < srv->expire) {
+    /* The last lookup failed. Don't flood the DNS with queries. */
+    return -1;
+  }
+
+  srv->expired = false;
+  srv->expire = now + p->resolve_interval;
+  if (p->resolve_jitter > 0)
+    srv->expire += (cdtime_t)cdrand_range(0, (long)p->resolve_jitter);
+
+  struct addrinfo ai_hints = {
+      .ai_family = AF_UNSPEC,
+      .ai_flags = AI_ADDRCONFIG,
+      .ai_socktype = p->udp ? SOCK_DGRAM : SOCK_STREAM,
+  };
+  struct addrinfo *ai_list = NULL;
+
+  int status = getaddrinfo(srv->node, srv->service, &ai_hints, &ai_list);
+  if (status != 0) {
+    c_complain(LOG_ERR, &srv->complaint,
+               "%s plugin: getaddrinfo (%s, %s) failed: %s%s", p->name,
+               srv->node, srv->service, gai_strerror(status),
+               (srv->addrs_num > 0) ? ". Using the previous addresses." : "");
+    return (srv->addrs_num > 0) ? 0 : -1;
+  }
+
+  size_t num = 0;
+  for (struct addrinfo *ai = ai_list; ai != NULL; ai = ai->ai_next)
+    num++;
+
+  struct addrinfo **addrs = calloc(num, sizeof(*addrs));
+  if (addrs == NULL) {
+    ERROR("%s plugin: calloc failed.", p->name);
+    freeaddrinfo(ai_list);
+    return (srv->addrs_num > 0) ? 0 : -1;
+  }
+  num = 0;
+  for (struct addrinfo *ai = ai_list; ai != NULL; ai = ai->ai_next)
+    addrs[num++] = ai;
+
+  if (srv->ai_list != NULL)
+    freeaddrinfo(srv->ai_list);
+  sfree(srv->addrs);
+  srv->ai_list = ai_list;
+  srv->addrs = addrs;
+  srv->addrs_num = num;
+
+  c_release(LOG_INFO, &srv->complaint,
+            "%s plugin: getaddrinfo (%s, %s) succeeded.", p->name, srv->node,
+            srv->service);
+  return 0;
+}
+
+static void tp_conn_close(c_tcp_pool_t *p, tp_conn_t *conn) {
+  if (conn->fd >= 0)
+    close(conn->fd);
+  conn->fd = -1;
+  conn->connecting = false;
+
+  if (conn->sending == NULL)
+    return;
+
+  /* A partially written buffer can't be sent again without breaking a
+   * message, so it is dropped. The other buffers go back to the front of the
+   * queue and are sent once the connection is back. */
+  tp_buffer_t *drop = NULL;
+  if (conn->sending_offset > 0) {
+    drop = conn->sending;
+    conn->sending = drop->next;
+    drop->next = NULL;
+  }
+
+  pthread_mutex_lock(&p->queue_lock);
+  tp_buffer_put_nolock(p, drop);
+  if (conn->sending != NULL) {
+    tp_buffer_t *last = conn->sending;
+    conn->queue_len += last->len;
+    while (last->next != NULL) {
+      last = last->next;
+      conn->queue_len += last->len;
+    }
+    last->next = conn->queue_head;
+    conn->queue_head = conn->sending;
+    if (conn->queue_tail == NULL)
+      conn->queue_tail = last;
+  }
+  pthread_mutex_unlock(&p->queue_lock);
+
+  conn->sending = NULL;
+  conn->sending_num = 0;
+  conn->sending_offset = 0;
+}
+
+/* tp_conn_fail closes a connection that could not be established or broke
+ * and moves on to the server's next address. */
+static void tp_conn_fail(c_tcp_pool_t *p, tp_conn_t *conn) {
+  tp_server_t *srv = conn->server;
+
+  tp_conn_close(p, conn);
+  __atomic_store_n(&conn->down, true, __ATOMIC_RELAXED);
+
+  conn->addr_next++;
+  conn->addrs_failed++;
+  if (conn->addrs_failed >= srv->addrs_num) {
+    conn->addrs_failed = 0;
+    if (p->resolve_interval == 0)
+      srv->expired = true;
+  }
+}
+
+static void tp_conn_established(c_tcp_pool_t *p, tp_conn_t *conn) {
+  conn->connecting = false;
+  conn->connect_time = cdtime();
+  conn->addrs_failed = 0;
+  __atomic_store_n(&conn->down, false, __ATOMIC_RELAXED);
+
+  c_release(LOG_INFO, &conn->complaint,
+            "%s plugin: Successfully connected to %s:%s.", p->name,
+            conn->server->node, conn->server->service);
+}
+
+static void tp_conn_open(c_tcp_pool_t *p, tp_conn_t *conn, cdtime_t now) {
+  tp_server_t *srv = conn->server;
+  char connerr[256] = "";
+
+  conn->last_connect_time = now;
+
+  if (tp_server_resolve(p, srv, now) != 0) {
+    __atomic_store_n(&conn->down, true, __ATOMIC_RELAXED);
+    return;
+  }
+
+  size_t attempts = srv->addrs_num;
+  for (size_t i = 0; i < attempts; i++) {
+    struct addrinfo *ai = srv->addrs[conn->addr_next % srv->addrs_num];
+
+    conn->fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (conn->fd < 0) {
+      snprintf(connerr, sizeof(connerr), "failed to open socket: %s", STRERRNO);
+      tp_conn_fail(p, conn);
+      continue;
+    }
+
+    set_sock_opts(conn->fd);
+
+    int flags = fcntl(conn->fd, F_GETFL);
+    if ((flags == -1) || (fcntl(conn->fd, F_SETFL, flags | O_NONBLOCK) != 0)) {
+      snprintf(connerr, sizeof(connerr), "fcntl failed: %s", STRERRNO);
+      tp_conn_fail(p, conn);
+      continue;
+    }
+
+    int status = connect(conn->fd, ai->ai_addr, ai->ai_addrlen);
+    if ((status != 0) && (errno == EINPROGRESS)) {
+      conn->connecting = true;
+      return;
+    } else if (status != 0) {
+      snprintf(connerr, sizeof(connerr), "failed to connect to remote host: %s",
+               STRERRNO);
+      tp_conn_fail(p, conn);
+      continue;
+    }
+
+    tp_conn_established(p, conn);
+    return;
+  }
+
+  c_complain(LOG_ERR, &conn->complaint,
+             "%s plugin: Connecting to %s:%s failed. The last error was: %s",
+             p->name, srv->node, srv->service, connerr);
+}
+
+/* tp_conn_connect_done checks the outcome of a non-blocking connect. */
+static void tp_conn_connect_done(c_tcp_pool_t *p, tp_conn_t *conn) {
+  int err = 0;
+  if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &err,
+                 &(socklen_t){sizeof(err)}) != 0)
+    err = errno;
+
+  if (err == 0) {
+    tp_conn_established(p, conn);
+    return;
+  }
+
+  c_complain(LOG_ERR, &conn->complaint,
+             "%s plugin: Connecting to %s:%s failed: %s", p->name,
+             conn->server->node, conn->server->service, STRERROR(err));
+  tp_conn_fail(p, conn);
+
+  /* Try the server's other addresses right away. */
+  if (conn->addrs_failed > 0)
+    conn->last_connect_time = 0;
+}
+
+/* tp_conn_write writes as many of the buffers being sent as the socket
+ * takes. Returns true if it made progress. */
+static bool tp_conn_write(c_tcp_pool_t *p, tp_conn_t *conn) {
+  struct iovec iov[TP_IOV_MAX];
+  int iov_num = 0;
+
+  for (tp_buffer_t *b = conn->sending; (b != NULL) && (iov_num < TP_IOV_MAX);
+       b = b->next) {
+    size_t offset = (iov_num == 0) ? conn->sending_offset : 0;
+    iov[iov_num] = (struct iovec){
+        .iov_base = b->data + offset,
+        .iov_len = b->len - offset,
+    };
+    iov_num++;
+
+    /* Every datagram must hold complete messages. */
+    if (p->udp)
+      break;
+  }
+
+  ssize_t status = writev(conn->fd, iov, iov_num);
+  if (status < 0) {
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+      return false;
+
+    if (!p->quiet_send_errors)
+      c_complain(LOG_ERR, &conn->complaint,
+                 "%s plugin: Sending to %s:%s failed: %s", p->name,
+                 conn->server->node, conn->server->service, STRERRNO);
+    tp_conn_fail(p, conn);
+    return false;
+  }
+
+  size_t written = (size_t)status;
+  tp_buffer_t *done = NULL;
+  tp_buffer_t **done_tail = &done;
+  while ((conn->sending != NULL) &&
+         (written >= conn->sending->len - conn->sending_offset)) {
+    tp_buffer_t *b = conn->sending;
+    written -= b->len - conn->sending_offset;
+    conn->sending = b->next;
+    conn->sending_num--;
+    conn->sending_offset = 0;
+
+    b->next = NULL;
+    *done_tail = b;
+    done_tail = &b->next;
+  }
+  conn->sending_offset += written;
+
+  if (done != NULL) {
+    pthread_mutex_lock(&p->queue_lock);
+    tp_buffer_put_nolock(p, done);
+    pthread_mutex_unlock(&p->queue_lock);
+  }
+
+  /* The message is complete, the next one gets a new connection. */
+  if (p->close_after_send && (conn->sending == NULL)) {
+    tp_conn_close(p, conn);
+    conn->last_connect_time = 0;
+  }
+  return true;
+}
+
+/* tp_conn_read reads and discards anything the server sends, mostly to
+ * notice when it closed the connection. */
+static void tp_conn_read(c_tcp_pool_t *p, tp_conn_t *conn) {
+  char buffer[4096];
+
+  ssize_t status = read(conn->fd, buffer, sizeof(buffer));
+  if ((status > 0) ||
+      ((status < 0) &&
+       ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))))
+    return;
+
+  if (status == 0) {
+    INFO("%s plugin: %s:%s closed the connection.", p->name,
+         conn->server->node, conn->server->service);
+    tp_conn_close(p, conn);
+    return;
+  }
+
+  if (!p->quiet_send_errors)
+    c_complain(LOG_ERR, &conn->complaint,
+               "%s plugin: Reading from %s:%s failed: %s", p->name,
+               conn->server->node, conn->server->service, STRERRNO);
+  tp_conn_fail(p, conn);
+}
+
+/* tp_conn_dequeue moves queued buffers to the connection's sending list once
+ * the previous ones have been written. Without "take", buffers stay in the
+ * queue, where the backlog limit applies to them. Returns true if there is
+ * anything to send. */
+static bool tp_conn_dequeue(c_tcp_pool_t *p, tp_conn_t *conn, bool take) {
+  if (conn->sending != NULL)
+    return true;
+
+  pthread_mutex_lock(&p->queue_lock);
+  if (!take) {
+    bool queued = (conn->queue_head != NULL);
+    pthread_mutex_unlock(&p->queue_lock);
+    return queued;
+  }
+
+  size_t max = p->close_after_send ? 1 : TP_IOV_MAX;
+  tp_buffer_t *head = conn->queue_head;
+  tp_buffer_t *last = NULL;
+  size_t num = 0;
+  for (tp_buffer_t *b = head; (b != NULL) && (num < max); b = b->next) {
+    conn->queue_len -= b->len;
+    last = b;
+    num++;
+  }
+  if (last != NULL) {
+    conn->queue_head = last->next;
+    if (conn->queue_head == NULL)
+      conn->queue_tail = NULL;
+    last->next = NULL;
+  }
+  if (conn->queue_head == NULL)
+    c_release(LOG_INFO, &conn->backlog_complaint,
+              "%s plugin: The backlog for %s:%s has been sent.", p->name,
+              conn->server->node, conn->server->service);
+  pthread_mutex_unlock(&p->queue_lock);
+
+  conn->sending = (num > 0) ? head : NULL;
+  conn->sending_num = num;
+  conn->sending_offset = 0;
+  return num > 0;
+}
+
+static void *tp_thread(void *arg) {
+  c_tcp_pool_t *p = arg;
+  cdtime_t stop_time = 0;
+
+  while (true) {
+    cdtime_t now = cdtime();
+
+    pthread_mutex_lock(&p->queue_lock);
+    bool stop = p->stop;
+    pthread_mutex_unlock(&p->queue_lock);
+    if (stop && (stop_time == 0))
+      stop_time = now;
+
+    bool pending = false;
+    p->pollfds[0] = (struct pollfd){.fd = p->wake_fd[0], .events = POLLIN};
+    for (size_t i = 0; i < p->conns_num; i++) {
+      tp_conn_t *conn = p->conns + i;
+
+      /* Reopen the connection periodically, but only between buffers. */
+      if ((p->reconnect_interval > 0) && (conn->fd >= 0) &&
+          !conn->connecting && (conn->sending == NULL) &&
+          ((now - conn->connect_time) >= p->reconnect_interval)) {
+        INFO("%s plugin: Connection to %s:%s closed after %.3f seconds.",
+             p->name, conn->server->node, conn->server->service,
+             CDTIME_T_TO_DOUBLE(now - conn->connect_time));
+        tp_conn_close(p, conn);
+        conn->last_connect_time = 0;
+      }
+
+      /* Don't try to reconnect too often. By default, one reconnection
+       * attempt is made per second. Connections that are closed after each
+       * message are only opened when there is something to send. A zero
+       * last_connect_time asks for a connection right away. */
+      if ((conn->fd < 0) &&
+          ((conn->last_connect_time == 0) ||
+           ((now - conn->last_connect_time) >= TP_MIN_RECONNECT_INTERVAL)) &&
+          (!p->close_after_send || tp_conn_dequeue(p, conn, false)))
+        tp_conn_open(p, conn, now);
+
+      bool connected = (conn->fd >= 0) && !conn->connecting;
+      bool has_data = tp_conn_dequeue(p, conn, connected);
+      pending = pending || has_data;
+
+      short events = 0;
+      if (conn->fd >= 0) {
+        if (conn->connecting || has_data)
+          events |= POLLOUT;
+        if (connected && !p->udp)
+          events |= POLLIN;
+      }
+      p->pollfds[i + 1] = (struct pollfd){
+          .fd = (events != 0) ? conn->fd : -1,
+          .events = events,
+      };
+    }
+
+    if (stop && (!pending || ((now - stop_time) >= TP_SHUTDOWN_TIMEOUT)))
+      break;
+
+    int status = poll(p->pollfds, p->conns_num + 1,
+                      /* timeout = */ stop ? 100 : 1000);
+    if (status < 0) {
+      if (errno != EINTR)
+        ERROR("%s plugin: poll failed: %s", p->name, STRERRNO);
+      continue;
+    }
+
+    if (p->pollfds[0].revents != 0) {
+      char buffer[64];
+      while (read(p->wake_fd[0], buffer, sizeof(buffer)) > 0)
+        ;
+    }
+
+    for (size_t i = 0; i < p->conns_num; i++) {
+      tp_conn_t *conn = p->conns + i;
+      short revents = p->pollfds[i + 1].revents;
+
+      if ((revents == 0) || (conn->fd < 0))
+        continue;
+
+      if (conn->connecting) {
+        tp_conn_connect_done(p, conn);
+        continue;
+      }
+
+      if (revents & (POLLIN | POLLERR | POLLHUP))
+        tp_conn_read(p, conn);
+      /* Datagrams are sent one buffer at a time. */
+      while ((conn->fd >= 0) && (revents & POLLOUT) &&
+             (conn->sending != NULL) && tp_conn_write(p, conn) && p->udp)
+        ;
+    }
+  }
+
+  uint64_t lost = 0;
+  for (size_t i = 0; i < p->conns_num; i++) {
+    tp_conn_t *conn = p->conns + i;
+    tp_conn_close(p, conn);
+    lost += conn->queue_len;
+  }
+  if (lost > 0)
+    WARNING("%s plugin: Shutting down with %" PRIu64
+            " bytes that could not be sent.",
+            p->name, lost);
+
+  return NULL;
+}
+
+/*
+ * Public functions
+ */
+c_tcp_pool_t *c_tcp_pool_create(c_tcp_pool_options_t const *opts) {
+  if ((opts == NULL) || (opts->name == NULL) || (opts->servers_num == 0) ||
+      (opts->connections == 0) || (opts->buffer_size == 0))
+    return NULL;
+
+  c_tcp_pool_t *p = calloc(1, sizeof(*p));
+  if (p == NULL)
+    return NULL;
+
+  pthread_mutex_init(&p->send_lock, NULL);
+  pthread_mutex_init(&p->queue_lock, NULL);
+  p->wake_fd[0] = p->wake_fd[1] = -1;
+
+  p->buffer_size = opts->buffer_size;
+  p->backlog_size = opts->backlog_size;
+  p->resolve_interval = opts->resolve_interval;
+  p->resolve_jitter = opts->resolve_jitter;
+  p->reconnect_interval = opts->reconnect_interval;
+  p->close_after_send = opts->close_after_send;
+  p->udp = opts->udp;
+  p->quiet_send_errors = opts->quiet_send_errors;
+  p->connections = opts->connections;
+
+  p->name = strdup(opts->name);
+  p->servers = calloc(opts->servers_num, sizeof(*p->servers));
+  p->conns = calloc(opts->servers_num * opts->connections, sizeof(*p->conns));
+  p->pollfds = calloc(opts->servers_num * opts->connections + 1,
+                      sizeof(*p->pollfds));
+  if ((p->name == NULL) || (p->servers == NULL) || (p->conns == NULL) ||
+      (p->pollfds == NULL)) {
+    c_tcp_pool_destroy(p);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < opts->servers_num; i++) {
+    tp_server_t *srv = p->servers + i;
+    p->servers_num++;
+
+    srv->node = strdup(opts->servers[i].node);
+    srv->service = strdup(opts->servers[i].service);
+    if ((srv->node == NULL) || (srv->service == NULL)) {
+      c_tcp_pool_destroy(p);
+      return NULL;
+    }
+    C_COMPLAIN_INIT(&srv->complaint);
+
+    for (size_t j = 0; j < opts->connections; j++) {
+      tp_conn_t *conn = p->conns + p->conns_num;
+      p->conns_num++;
+
+      conn->server = srv;
+      conn->fd = -1;
+      /* Spread the connections of a server over its addresses. */
+      conn->addr_next = j;
+      C_COMPLAIN_INIT(&conn->complaint);
+      C_COMPLAIN_INIT(&conn->backlog_complaint);
+    }
+  }
+
+  if (tp_ring_create(p) != 0) {
+    c_tcp_pool_destroy(p);
+    return NULL;
+  }
+
+  if (pipe(p->wake_fd) != 0) {
+    ERROR("%s plugin: pipe failed: %s", p->name, STRERRNO);
+    p->wake_fd[0] = p->wake_fd[1] = -1;
+    c_tcp_pool_destroy(p);
+    return NULL;
+  }
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(p->wake_fd); i++) {
+    int flags = fcntl(p->wake_fd[i], F_GETFL);
+    fcntl(p->wake_fd[i], F_SETFL, flags | O_NONBLOCK);
+  }
+
+  int status = pthread_create(&p->thread, /* attr = */ NULL, tp_thread, p);
+  if (status != 0) {
+    ERROR("%s plugin: Starting the I/O thread failed: %s", p->name,
+          STRERROR(status));
+    c_tcp_pool_destroy(p);
+    return NULL;
+  }
+  p->thread_started = true;
+
+#if HAVE_PTHREAD_SETNAME_NP
+  char thread_name[16];
+  sstrncpy(thread_name, p->name, sizeof(thread_name));
+  pthread_setname_np(p->thread, thread_name);
+#endif
+
+  return p;
+}
+
+void c_tcp_pool_destroy(c_tcp_pool_t *p) {
+  if (p == NULL)
+    return;
+
+  if (p->thread_started) {
+    c_tcp_pool_flush(p, /* timeout = */ 0);
+
+    pthread_mutex_lock(&p->queue_lock);
+    p->stop = true;
+    pthread_mutex_unlock(&p->queue_lock);
+    tp_wake(p);
+
+    pthread_join(p->thread, NULL);
+  }
+
+  for (size_t i = 0; i < p->conns_num; i++) {
+    tp_conn_t *conn = p->conns + i;
+    tp_buffer_free(conn->fill);
+    tp_buffer_free(conn->queue_head);
+    tp_buffer_free(conn->sending);
+  }
+  tp_buffer_free(p->idle);
+
+  for (size_t i = 0; i < p->servers_num; i++) {
+    tp_server_t *srv = p->servers + i;
+    sfree(srv->node);
+    sfree(srv->service);
+    if (srv->ai_list != NULL)
+      freeaddrinfo(srv->ai_list);
+    sfree(srv->addrs);
+  }
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(p->wake_fd); i++)
+    if (p->wake_fd[i] >= 0)
+      close(p->wake_fd[i]);
+
+  sfree(p->servers);
+  sfree(p->conns);
+  sfree(p->ring);
+  sfree(p->pollfds);
+  sfree(p->name);
+
+  pthread_mutex_destroy(&p->send_lock);
+  pthread_mutex_destroy(&p->queue_lock);
+  sfree(p);
+}
+
+/* tp_append copies the message to the connection's fill buffer. Must hold
+ * p->send_lock when calling. */
+static int tp_append(c_tcp_pool_t *p, tp_conn_t *conn, char const *msg,
+                     size_t len) {
+  if (conn->fill == NULL) {
+    conn->fill = tp_buffer_get(p, len);
+    if (conn->fill == NULL)
+      return ENOMEM;
+    conn->fill_init_time = cdtime();
+  }
+
+  memcpy(conn->fill->data + conn->fill->len, msg, len);
+  conn->fill->len += len;
+  return 0;
+}
+
+int c_tcp_pool_send(c_tcp_pool_t *p, char const *msg, size_t len) {
+  if ((p == NULL) || (msg == NULL))
+    return EINVAL;
+  if (len == 0)
+    return 0;
+
+  pthread_mutex_lock(&p->send_lock);
+
+  tp_conn_t *conn = p->conns + p->conn_current;
+  if ((conn->fill != NULL) && ((conn->fill->size - conn->fill->len) < len)) {
+    tp_enqueue(p, conn);
+    tp_next_conn(p);
+    conn = p->conns + p->conn_current;
+  }
+
+  int status = tp_append(p, conn, msg, len);
+  if ((status == 0) && p->close_after_send) {
+    tp_enqueue(p, conn);
+    tp_next_conn(p);
+  }
+
+  pthread_mutex_unlock(&p->send_lock);
+  return status;
+}
+
+int c_tcp_pool_send_hash(c_tcp_pool_t *p, uint64_t hash, char const *msg,
+                         size_t len) {
+  if ((p == NULL) || (msg == NULL))
+    return EINVAL;
+  if (len == 0)
+    return 0;
+
+  hash = tp_hash_mix(hash);
+  size_t server = tp_ring_lookup(p, hash);
+  size_t index = (size_t)((hash >> 32) % (uint64_t)p->connections);
+  tp_conn_t *conn = p->conns + server * p->connections + index;
+
+  pthread_mutex_lock(&p->send_lock);
+
+  if ((conn->fill != NULL) && ((conn->fill->size - conn->fill->len) < len))
+    tp_enqueue(p, conn);
+
+  int status = tp_append(p, conn, msg, len);
+  if ((status == 0) && p->close_after_send)
+    tp_enqueue(p, conn);
+
+  pthread_mutex_unlock(&p->send_lock);
+  return status;
+}
+
+void c_tcp_pool_flush(c_tcp_pool_t *p, cdtime_t timeout) {
+  if (p == NULL)
+    return;
+
+  cdtime_t now = cdtime();
+
+  pthread_mutex_lock(&p->send_lock);
+  for (size_t i = 0; i < p->conns_num; i++) {
+    tp_conn_t *conn = p->conns + i;
+
+    if (conn->fill == NULL)
+      continue;
+
+    /* timeout == 0  => flush unconditionally */
+    if ((timeout > 0) && ((conn->fill_init_time + timeout) > now))
+      continue;
+
+    tp_enqueue(p, conn);
+  }
+  pthread_mutex_unlock(&p->send_lock);
+}
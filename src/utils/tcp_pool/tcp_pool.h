@@ -0,0 +1,156 @@
+/**
+ * collectd - src/utils/tcp_pool/tcp_pool.h
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_TCP_POOL_H
+#define UTILS_TCP_POOL_H 1
+
+#include "utils_time.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Pool of TCP connections for plugins that send text based protocols, such as
+ * OpenTSDB's "put" lines. Write threads append complete messages to a
+ * connection's buffer and return immediately; full buffers are queued. A
+ * single thread connects without blocking and writes up to 64 queued buffers
+ * at once with writev(2), so that neither a slow nor a dead server holds up
+ * the write threads. Resolved addresses are cached for a configurable time.
+ * Optionally, the buffers are sent as UDP datagrams instead.
+ */
+struct c_tcp_pool_s;
+typedef struct c_tcp_pool_s c_tcp_pool_t;
+
+typedef struct {
+  char const *node;
+  char const *service;
+} c_tcp_pool_server_t;
+
+typedef struct {
+  /* Name of the owning plugin. Used in log messages and as the name of the
+   * I/O thread. */
+  char const *name;
+
+  c_tcp_pool_server_t const *servers;
+  size_t servers_num;
+  /* Number of connections opened to each server. Messages are spread over all
+   * connections in turn, skipping connections that are down. */
+  size_t connections;
+
+  /* Size of the buffers messages are collected in. A message never spans two
+   * buffers. */
+  size_t buffer_size;
+  /* Maximum number of bytes queued per connection. Once it is reached, the
+   * oldest buffers are dropped. */
+  size_t backlog_size;
+
+  /* Resolved addresses are used for resolve_interval plus a random time of up
+   * to resolve_jitter. If looking up a server fails, its previous addresses
+   * are used for another interval. With a zero resolve_interval, addresses
+   * are kept until connecting to all of them failed. */
+  cdtime_t resolve_interval;
+  cdtime_t resolve_jitter;
+
+  /* Send each message on its own connection and close the connection once
+   * the message has been written, for servers that expect one message per
+   * connection. */
+  bool close_after_send;
+
+  /* Close connections that have been open for this long once their current
+   * buffers have been written, and connect again. Useful behind load
+   * balancers. Zero keeps connections open. */
+  cdtime_t reconnect_interval;
+
+  /* Send each buffer as a UDP datagram. Messages never span two datagrams. */
+  bool udp;
+
+  /* Don't log failures to send to or read from a server. */
+  bool quiet_send_errors;
+} c_tcp_pool_options_t;
+
+/*
+ * NAME
+ *   c_tcp_pool_create
+ *
+ * DESCRIPTION
+ *   Allocates a new pool and starts its I/O thread, which connects to the
+ *   servers in the background. The options are copied.
+ *
+ * RETURN VALUE
+ *   A c_tcp_pool_t-pointer upon success or NULL upon failure.
+ */
+c_tcp_pool_t *c_tcp_pool_create(c_tcp_pool_options_t const *opts);
+
+/*
+ * NAME
+ *   c_tcp_pool_destroy
+ *
+ * DESCRIPTION
+ *   Queues all buffered messages, tries to send them for up to two seconds,
+ *   stops the I/O thread and deallocates the pool. No other thread must be
+ *   using the pool anymore.
+ */
+void c_tcp_pool_destroy(c_tcp_pool_t *p);
+
+/*
+ * NAME
+ *   c_tcp_pool_send
+ *
+ * DESCRIPTION
+ *   Appends a copy of the `len' bytes at `msg' to the current connection's
+ *   buffer. `msg' may hold several lines, which are kept together. Does not
+ *   block on the network.
+ *
+ * RETURN VALUE
+ *   Zero upon success or an errno value upon failure.
+ */
+int c_tcp_pool_send(c_tcp_pool_t *p, char const *msg, size_t len);
+
+/*
+ * NAME
+ *   c_tcp_pool_send_hash
+ *
+ * DESCRIPTION
+ *   Like c_tcp_pool_send, but messages with the same `hash', e.g. the hash of
+ *   the metric's identifier, always go to the same server and connection. The
+ *   servers are placed on a consistent hashing ring, so adding or removing a
+ *   server only moves the messages of that server.
+ *
+ * RETURN VALUE
+ *   Zero upon success or an errno value upon failure.
+ */
+int c_tcp_pool_send_hash(c_tcp_pool_t *p, uint64_t hash, char const *msg,
+                         size_t len);
+
+/*
+ * NAME
+ *   c_tcp_pool_flush
+ *
+ * DESCRIPTION
+ *   Queues the buffers that have been filled for more than `timeout'. A zero
+ *   `timeout' queues all buffers.
+ */
+void c_tcp_pool_flush(c_tcp_pool_t *p, cdtime_t timeout);
+
+#endif /* UTILS_TCP_POOL_H */
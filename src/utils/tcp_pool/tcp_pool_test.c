@@ -0,0 +1,319 @@
+/**
+ * collectd - src/utils/tcp_pool/tcp_pool_test.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/tcp_pool/tcp_pool.h"
+
+#include <netinet/in.h>
+#include <poll.h>
+
+/* Opens a listening socket on an ephemeral port of the loopback interface and
+ * stores the port in "service". */
+static int listen_local_type(int type, char *service, size_t service_size) {
+  int fd = socket(AF_INET, type, 0);
+  if (fd < 0)
+    return -1;
+
+  struct sockaddr_in sa = {
+      .sin_family = AF_INET,
+      .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+  };
+  socklen_t sa_len = sizeof(sa);
+  if ((bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) ||
+      ((type == SOCK_STREAM) && (listen(fd, 16) != 0)) ||
+      (getsockname(fd, (struct sockaddr *)&sa, &sa_len) != 0)) {
+    close(fd);
+    return -1;
+  }
+
+  snprintf(service, service_size, "%d", (int)ntohs(sa.sin_port));
+  return fd;
+}
+
+static int listen_local(char *service, size_t service_size) {
+  return listen_local_type(SOCK_STREAM, service, service_size);
+}
+
+/* Accepts a connection and reads from it until the peer closes it or nothing
+ * arrives for a second. Returns the number of bytes read. */
+static ssize_t accept_read(int listen_fd, char *buf, size_t size) {
+  struct pollfd pfd = {.fd = listen_fd, .events = POLLIN};
+  if (poll(&pfd, 1, 5000) != 1)
+    return -1;
+
+  int fd = accept(listen_fd, NULL, NULL);
+  if (fd < 0)
+    return -1;
+
+  size_t len = 0;
+  while (len < size) {
+    pfd = (struct pollfd){.fd = fd, .events = POLLIN};
+    if (poll(&pfd, 1, 1000) != 1)
+      break;
+
+    ssize_t status = read(fd, buf + len, size - len);
+    if (status <= 0)
+      break;
+    len += (size_t)status;
+  }
+
+  close(fd);
+  return (ssize_t)len;
+}
+
+DEF_TEST(send) {
+  char service[16];
+  int listen_fd;
+  OK(0 <= (listen_fd = listen_local(service, sizeof(service))));
+
+  c_tcp_pool_server_t server = {.node = "127.0.0.1", .service = service};
+  c_tcp_pool_options_t opts = {
+      .name = "test",
+      .servers = &server,
+      .servers_num = 1,
+      .connections = 1,
+      .buffer_size = 64,
+      .backlog_size = 1024 * 1024,
+  };
+  c_tcp_pool_t *p;
+  CHECK_NOT_NULL(p = c_tcp_pool_create(&opts));
+
+  char want[8192] = "";
+  size_t want_len = 0;
+  for (int i = 0; i < 200; i++) {
+    char line[64];
+    int len = snprintf(line, sizeof(line), "put metric.%d %d 1\r\n", i, i);
+    EXPECT_EQ_INT(0, c_tcp_pool_send(p, line, (size_t)len));
+    memcpy(want + want_len, line, (size_t)len);
+    want_len += (size_t)len;
+  }
+  /* larger than a buffer */
+  char big[200];
+  memset(big, 'x', sizeof(big) - 1);
+  big[sizeof(big) - 1] = '\n';
+  EXPECT_EQ_INT(0, c_tcp_pool_send(p, big, sizeof(big)));
+  memcpy(want + want_len, big, sizeof(big));
+  want_len += sizeof(big);
+  c_tcp_pool_flush(p, /* timeout = */ 0);
+
+  char got[8192];
+  ssize_t got_len = accept_read(listen_fd, got, sizeof(got));
+  EXPECT_EQ_INT((int)want_len, (int)got_len);
+  got[(got_len > 0) ? got_len : 0] = 0;
+  want[want_len] = 0;
+  EXPECT_EQ_STR(want, got);
+
+  c_tcp_pool_destroy(p);
+  close(listen_fd);
+  return 0;
+}
+
+DEF_TEST(close_after_send) {
+  char service[16];
+  int listen_fd;
+  OK(0 <= (listen_fd = listen_local(service, sizeof(service))));
+
+  c_tcp_pool_server_t server = {.node = "127.0.0.1", .service = service};
+  c_tcp_pool_options_t opts = {
+      .name = "test",
+      .servers = &server,
+      .servers_num = 1,
+      .connections = 2,
+      .buffer_size = 64,
+      .backlog_size = 1024 * 1024,
+      .close_after_send = true,
+  };
+  c_tcp_pool_t *p;
+  CHECK_NOT_NULL(p = c_tcp_pool_create(&opts));
+
+  for (int i = 0; i < 4; i++) {
+    char msg[64];
+    int len = snprintf(msg, sizeof(msg), "{\"message\": %d}", i);
+    EXPECT_EQ_INT(0, c_tcp_pool_send(p, msg, (size_t)len));
+  }
+
+  /* every message arrives on a connection of its own */
+  int seen = 0;
+  for (int i = 0; i < 4; i++) {
+    char got[64];
+    ssize_t got_len = accept_read(listen_fd, got, sizeof(got) - 1);
+    OK(got_len > 0);
+    got[got_len] = 0;
+
+    int num = -1;
+    EXPECT_EQ_INT(1, sscanf(got, "{\"message\": %d}", &num));
+    OK((num >= 0) && (num < 4));
+    seen |= 1 << num;
+  }
+  EXPECT_EQ_INT(0x0f, seen);
+
+  c_tcp_pool_destroy(p);
+  close(listen_fd);
+  return 0;
+}
+
+DEF_TEST(udp) {
+  char service[16];
+  int fd;
+  OK(0 <= (fd = listen_local_type(SOCK_DGRAM, service, sizeof(service))));
+
+  c_tcp_pool_server_t server = {.node = "127.0.0.1", .service = service};
+  c_tcp_pool_options_t opts = {
+      .name = "test",
+      .servers = &server,
+      .servers_num = 1,
+      .connections = 1,
+      .buffer_size = 64,
+      .backlog_size = 1024 * 1024,
+      .udp = true,
+  };
+  c_tcp_pool_t *p;
+  CHECK_NOT_NULL(p = c_tcp_pool_create(&opts));
+
+  char want[1024] = "";
+  size_t want_len = 0;
+  for (int i = 0; i < 20; i++) {
+    char line[64];
+    int len = snprintf(line, sizeof(line), "metric.%d %d 1\n", i, i);
+    EXPECT_EQ_INT(0, c_tcp_pool_send(p, line, (size_t)len));
+    memcpy(want + want_len, line, (size_t)len);
+    want_len += (size_t)len;
+  }
+  c_tcp_pool_flush(p, /* timeout = */ 0);
+
+  /* every datagram holds complete lines */
+  char got[1024];
+  size_t got_len = 0;
+  while (got_len < want_len) {
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    if (poll(&pfd, 1, 5000) != 1)
+      break;
+
+    ssize_t status = recv(fd, got + got_len, sizeof(got) - got_len, 0);
+    OK(status > 0);
+    OK(status <= 64);
+    EXPECT_EQ_INT('\n', got[got_len + (size_t)status - 1]);
+    got_len += (size_t)status;
+  }
+  got[got_len] = 0;
+  want[want_len] = 0;
+  EXPECT_EQ_STR(want, got);
+
+  c_tcp_pool_destroy(p);
+  close(fd);
+  return 0;
+}
+
+DEF_TEST(send_hash) {
+  char services[2][16];
+  int listen_fds[2];
+  c_tcp_pool_server_t servers[2];
+  for (size_t i = 0; i < 2; i++) {
+    OK(0 <= (listen_fds[i] =
+                 listen_local(services[i], sizeof(services[i]))));
+    servers[i] = (c_tcp_pool_server_t){.node = "127.0.0.1",
+                                       .service = services[i]};
+  }
+
+  c_tcp_pool_options_t opts = {
+      .name = "test",
+      .servers = servers,
+      .servers_num = 2,
+      .connections = 2,
+      .buffer_size = 64,
+      .backlog_size = 1024 * 1024,
+  };
+  c_tcp_pool_t *p;
+  CHECK_NOT_NULL(p = c_tcp_pool_create(&opts));
+
+  for (int round = 0; round < 3; round++) {
+    for (uint64_t key = 0; key < 64; key++) {
+      char line[64];
+      int len = snprintf(line, sizeof(line), "key.%" PRIu64 "\n", key);
+      EXPECT_EQ_INT(0, c_tcp_pool_send_hash(p, key * 0x9e3779b97f4a7c15ULL,
+                                            line, (size_t)len));
+    }
+  }
+  c_tcp_pool_flush(p, /* timeout = */ 0);
+
+  /* Each server gets two connections. All lines of a key arrive on the same
+   * one, and the keys are spread over both servers. */
+  int counts[64] = {0};
+  int conns_used = 0;
+  for (size_t i = 0; i < 4; i++) {
+    char got[4096];
+    ssize_t got_len = accept_read(listen_fds[i % 2], got, sizeof(got) - 1);
+    if (got_len <= 0)
+      continue;
+    got[got_len] = 0;
+    conns_used++;
+
+    for (char *line = strtok(got, "\n"); line != NULL;
+         line = strtok(NULL, "\n")) {
+      int key = -1;
+      EXPECT_EQ_INT(1, sscanf(line, "key.%d", &key));
+      OK((key >= 0) && (key < 64));
+      counts[key]++;
+    }
+    /* Lines of the same key can't have been split over connections. */
+    for (size_t key = 0; key < 64; key++)
+      OK((counts[key] == 0) || (counts[key] == 3));
+    memset(counts, 0, sizeof(counts));
+  }
+  EXPECT_EQ_INT(4, conns_used);
+
+  c_tcp_pool_destroy(p);
+  for (size_t i = 0; i < 2; i++)
+    close(listen_fds[i]);
+  return 0;
+}
+
+DEF_TEST(invalid) {
+  c_tcp_pool_server_t server = {.node = "localhost", .service = "4242"};
+  c_tcp_pool_options_t opts = {
+      .name = "test",
+      .servers = &server,
+      .servers_num = 1,
+      .connections = 0,
+      .buffer_size = 1428,
+  };
+  EXPECT_EQ_PTR(NULL, c_tcp_pool_create(&opts));
+  EXPECT_EQ_PTR(NULL, c_tcp_pool_create(NULL));
+  EXPECT_EQ_INT(EINVAL, c_tcp_pool_send(NULL, "x\n", 2));
+  EXPECT_EQ_INT(EINVAL, c_tcp_pool_send_hash(NULL, 0, "x\n", 2));
+  c_tcp_pool_flush(NULL, 0);
+  c_tcp_pool_destroy(NULL);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(send);
+  RUN_TEST(close_after_send);
+  RUN_TEST(udp);
+  RUN_TEST(send_hash);
+  RUN_TEST(invalid);
+
+  END_TEST;
+}
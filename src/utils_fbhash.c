@@ -34,6 +34,10 @@
 struct fbhash_s {
   char *filename;
   time_t mtime;
+  /* The file's mtime has a resolution of one second, so it's checked at most
+   * once per second. */
+  time_t last_check;
+  uint64_t generation;
 
   pthread_mutex_t lock;
   c_avl_tree_t *tree;
@@ -161,6 +165,7 @@ static int fbh_read_file(fbhash_t *h) /* {{{ */
 
   fbh_free_tree(h->tree);
   h->tree = tree;
+  h->generation++;
 
   return 0;
 } /* }}} int fbh_read_file */
@@ -184,6 +189,19 @@ static int fbh_check_file(fbhash_t *h) /* {{{ */
   return status;
 } /* }}} int fbh_check_file */
 
+/* Like fbh_check_file() but skips the stat(2) if the file has been checked
+ * during the current second already. The caller must hold `h->lock'. */
+static void fbh_check_file_limited(fbhash_t *h) /* {{{ */
+{
+  time_t now = time(NULL);
+
+  if (now == h->last_check)
+    return;
+  h->last_check = now;
+
+  fbh_check_file(h);
+} /* }}} void fbh_check_file_limited */
+
 /*
  * Public functions
  */
@@ -206,6 +224,7 @@ fbhash_t *fbh_create(const char *file) /* {{{ */
   }
 
   h->mtime = 0;
+  h->last_check = time(NULL);
   pthread_mutex_init(&h->lock, /* attr = */ NULL);
 
   status = fbh_check_file(h);
@@ -242,8 +261,7 @@ char *fbh_get(fbhash_t *h, const char *key) /* {{{ */
 
   pthread_mutex_lock(&h->lock);
 
-  /* TODO: Checking this every time may be a bit much..? */
-  fbh_check_file(h);
+  fbh_check_file_limited(h);
 
   status = c_avl_get(h->tree, key, (void *)&value);
   if (status == 0) {
@@ -255,3 +273,18 @@ char *fbh_get(fbhash_t *h, const char *key) /* {{{ */
 
   return value_copy;
 } /* }}} char *fbh_get */
+
+uint64_t fbh_generation(fbhash_t *h) /* {{{ */
+{
+  uint64_t generation;
+
+  if (h == NULL)
+    return 0;
+
+  pthread_mutex_lock(&h->lock);
+  fbh_check_file_limited(h);
+  generation = h->generation;
+  pthread_mutex_unlock(&h->lock);
+
+  return generation;
+} /* }}} uint64_t fbh_generation */
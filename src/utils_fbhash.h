@@ -47,4 +47,8 @@ void fbh_destroy(fbhash_t *h);
  * responsibility to free this memory. */
 char *fbh_get(fbhash_t *h, const char *key);
 
+/* Returns a number that changes whenever the file has been re-read. Values
+ * returned by `fbh_get' may be cached until the generation changes. */
+uint64_t fbh_generation(fbhash_t *h);
+
 #endif /* UTILS_FBHASH_H */
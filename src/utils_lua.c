@@ -98,44 +98,71 @@ static int ltoc_table_values(lua_State *L, int idx, /* {{{ */
   return status;
 } /* }}} int ltoc_table_values */
 
-static int luaC_pushvalues(lua_State *L, const data_set_t *ds,
-                           const value_list_t *vl) /* {{{ */
+/* Removes the entries t[first], t[first + 1], ... of the table on top of the
+ * stack, up to the first nil entry. */
+static void luaC_truncate(lua_State *L, lua_Integer first) /* {{{ */
 {
-  assert(vl->values_len == ds->ds_num);
+  for (lua_Integer i = first;; i++) {
+    lua_rawgeti(L, -1, i);
+    bool is_nil = lua_isnil(L, -1);
+    lua_pop(L, 1);
+    if (is_nil)
+      break;
+
+    lua_pushnil(L);
+    lua_rawseti(L, -2, i);
+  }
+} /* }}} void luaC_truncate */
+
+/* Pushes the table stored in field `name' of the table at the absolute index
+ * `idx', creating it if necessary. */
+static void luaC_pushsubtable(lua_State *L, int idx, const char *name) /* {{{ */
+{
+  lua_getfield(L, idx, name);
+  if (lua_istable(L, -1))
+    return;
 
+  lua_pop(L, 1);
   lua_newtable(L);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, idx, name);
+} /* }}} void luaC_pushsubtable */
+
+static int luaC_setvalues(lua_State *L, const data_set_t *ds,
+                          const value_list_t *vl) /* {{{ */
+{
+  assert(vl->values_len == ds->ds_num);
+
   for (size_t i = 0; i < vl->values_len; i++) {
-    lua_pushinteger(L, (lua_Integer)i + 1);
     luaC_pushvalue(L, vl->values[i], ds->ds[i].type);
-    lua_settable(L, -3);
+    lua_rawseti(L, -2, (lua_Integer)i + 1);
   }
+  luaC_truncate(L, (lua_Integer)vl->values_len + 1);
 
   return 0;
-} /* }}} int luaC_pushvalues */
+} /* }}} int luaC_setvalues */
 
-static int luaC_pushdstypes(lua_State *L, const data_set_t *ds) /* {{{ */
+static int luaC_setdstypes(lua_State *L, const data_set_t *ds) /* {{{ */
 {
-  lua_newtable(L);
   for (size_t i = 0; i < ds->ds_num; i++) {
-    lua_pushinteger(L, (lua_Integer)i);
     lua_pushstring(L, DS_TYPE_TO_STRING(ds->ds[i].type));
-    lua_settable(L, -3);
+    lua_rawseti(L, -2, (lua_Integer)i);
   }
+  luaC_truncate(L, (lua_Integer)ds->ds_num);
 
   return 0;
-} /* }}} int luaC_pushdstypes */
+} /* }}} int luaC_setdstypes */
 
-static int luaC_pushdsnames(lua_State *L, const data_set_t *ds) /* {{{ */
+static int luaC_setdsnames(lua_State *L, const data_set_t *ds) /* {{{ */
 {
-  lua_newtable(L);
   for (size_t i = 0; i < ds->ds_num; i++) {
-    lua_pushinteger(L, (lua_Integer)i);
     lua_pushstring(L, ds->ds[i].name);
-    lua_settable(L, -3);
+    lua_rawseti(L, -2, (lua_Integer)i);
   }
+  luaC_truncate(L, (lua_Integer)ds->ds_num);
 
   return 0;
-} /* }}} int luaC_pushdsnames */
+} /* }}} int luaC_setdsnames */
 
 /*
  * Public functions
@@ -278,38 +305,52 @@ int luaC_pushvalue(lua_State *L, value_t v, int ds_type) /* {{{ */
   return 0;
 } /* }}} int luaC_pushvalue */
 
-int luaC_pushvaluelist(lua_State *L, const data_set_t *ds,
-                       const value_list_t *vl) /* {{{ */
+int luaC_setvaluelist(lua_State *L, int idx, const data_set_t *ds,
+                      const value_list_t *vl) /* {{{ */
 {
-  lua_newtable(L);
+  if (idx < 1)
+    idx += lua_gettop(L) + 1;
+
+  if (!lua_istable(L, idx))
+    return -1;
 
   lua_pushstring(L, vl->host);
-  lua_setfield(L, -2, "host");
+  lua_setfield(L, idx, "host");
 
   lua_pushstring(L, vl->plugin);
-  lua_setfield(L, -2, "plugin");
+  lua_setfield(L, idx, "plugin");
   lua_pushstring(L, vl->plugin_instance);
-  lua_setfield(L, -2, "plugin_instance");
+  lua_setfield(L, idx, "plugin_instance");
 
   lua_pushstring(L, vl->type);
-  lua_setfield(L, -2, "type");
+  lua_setfield(L, idx, "type");
   lua_pushstring(L, vl->type_instance);
-  lua_setfield(L, -2, "type_instance");
+  lua_setfield(L, idx, "type_instance");
 
-  luaC_pushvalues(L, ds, vl);
-  lua_setfield(L, -2, "values");
+  luaC_pushsubtable(L, idx, "values");
+  luaC_setvalues(L, ds, vl);
+  lua_pop(L, 1);
 
-  luaC_pushdstypes(L, ds);
-  lua_setfield(L, -2, "dstypes");
+  luaC_pushsubtable(L, idx, "dstypes");
+  luaC_setdstypes(L, ds);
+  lua_pop(L, 1);
 
-  luaC_pushdsnames(L, ds);
-  lua_setfield(L, -2, "dsnames");
+  luaC_pushsubtable(L, idx, "dsnames");
+  luaC_setdsnames(L, ds);
+  lua_pop(L, 1);
 
   luaC_pushcdtime(L, vl->time);
-  lua_setfield(L, -2, "time");
+  lua_setfield(L, idx, "time");
 
   luaC_pushcdtime(L, vl->interval);
-  lua_setfield(L, -2, "interval");
+  lua_setfield(L, idx, "interval");
 
   return 0;
+} /* }}} int luaC_setvaluelist */
+
+int luaC_pushvaluelist(lua_State *L, const data_set_t *ds,
+                       const value_list_t *vl) /* {{{ */
+{
+  lua_newtable(L);
+  return luaC_setvaluelist(L, -1, ds, vl);
 } /* }}} int luaC_pushvaluelist */
@@ -49,4 +49,12 @@ int luaC_pushvalue(lua_State *L, value_t v, int ds_type);
 int luaC_pushvaluelist(lua_State *L, const data_set_t *ds,
                        const value_list_t *vl);
 
+/*
+ * update functions (C -> existing table)
+ */
+/* Sets the fields of the table at `idx' like luaC_pushvaluelist, reusing its
+ * "values", "dstypes" and "dsnames" tables. */
+int luaC_setvaluelist(lua_State *L, int idx, const data_set_t *ds,
+                      const value_list_t *vl);
+
 #endif /* UTILS_LUA_H */
@@ -46,9 +46,41 @@ typedef struct VSC_C_main c_varnish_stats_t;
 typedef struct varnish_stats c_varnish_stats_t;
 #endif
 
+#if HAVE_VARNISH_V5 || HAVE_VARNISH_V6
+/* {{{ varnish_plan_s */
+typedef struct {
+  const volatile uint64_t *ptr;
+  int ds_type;
+  char plugin_instance[DATA_MAX_NAME_LEN];
+  char type[DATA_MAX_NAME_LEN];
+  char type_instance[DATA_MAX_NAME_LEN];
+} varnish_point_t;
+
+/* The VSM/VSC handles stay attached between reads. The configured counters
+ * are resolved to their location in shared memory once and only resolved
+ * again when VSM_Status() reports a change of the segments. */
+struct varnish_plan_s {
+  struct vsm *vd;
+  struct vsc *vsc;
+
+  varnish_point_t *points;
+  size_t points_num;
+  size_t points_size;
+
+  /* Set while VSC_Iter() resolves the counters; "resolving" is the value of
+   * the point currently being visited. */
+  bool resolve;
+  const volatile uint64_t *resolving;
+};
+typedef struct varnish_plan_s varnish_plan_t; /* }}} */
+#endif
+
 /* {{{ user_config_s */
 struct user_config_s {
   char *instance;
+#if HAVE_VARNISH_V5 || HAVE_VARNISH_V6
+  varnish_plan_t *plan;
+#endif
 
   bool collect_cache;
   bool collect_connections;
@@ -100,14 +132,40 @@ typedef struct user_config_s user_config_t; /* }}} */
 
 static bool have_instance;
 
-static int varnish_submit(const char *plugin_instance, /* {{{ */
+#if HAVE_VARNISH_V5 || HAVE_VARNISH_V6
+/* Resolves a configured counter to the location of its value in the mapped
+ * VSM segment, see varnish_plan_resolve(). */
+static int varnish_plan_add(varnish_plan_t *plan, /* {{{ */
+                            const value_list_t *vl, int ds_type) {
+  if (plan->points_num >= plan->points_size) {
+    size_t new_size = (plan->points_size == 0) ? 64 : 2 * plan->points_size;
+    varnish_point_t *tmp = realloc(plan->points, new_size * sizeof(*tmp));
+    if (tmp == NULL)
+      return ENOMEM;
+    plan->points = tmp;
+    plan->points_size = new_size;
+  }
+
+  varnish_point_t *point = plan->points + plan->points_num;
+  point->ptr = plan->resolving;
+  point->ds_type = ds_type;
+  sstrncpy(point->plugin_instance, vl->plugin_instance,
+           sizeof(point->plugin_instance));
+  sstrncpy(point->type, vl->type, sizeof(point->type));
+  sstrncpy(point->type_instance, vl->type_instance,
+           sizeof(point->type_instance));
+  plan->points_num++;
+
+  return 0;
+} /* }}} int varnish_plan_add */
+#endif
+
+static int varnish_submit(const user_config_t *conf, /* {{{ */
                           const char *category, const char *target,
                           const char *type, const char *type_instance,
-                          value_t value) {
+                          int ds_type, uint64_t raw) {
   value_list_t vl = VALUE_LIST_INIT;
-
-  vl.values = &value;
-  vl.values_len = 1;
+  const char *plugin_instance = conf->instance;
 
   sstrncpy(vl.plugin, "varnish", sizeof(vl.plugin));
 
@@ -127,53 +185,58 @@ static int varnish_submit(const char *plugin_instance, /* {{{ */
   if (type_instance != NULL)
     sstrncpy(vl.type_instance, type_instance, sizeof(vl.type_instance));
 
+#if HAVE_VARNISH_V5 || HAVE_VARNISH_V6
+  if ((conf->plan != NULL) && conf->plan->resolve)
+    return varnish_plan_add(conf->plan, &vl, ds_type);
+#endif
+
+  value_t value;
+  if (ds_type == DS_TYPE_GAUGE)
+    value.gauge = (gauge_t)raw;
+  else
+    value.derive = (derive_t)raw;
+
+  vl.values = &value;
+  vl.values_len = 1;
+
   return plugin_dispatch_values(&vl);
 } /* }}} int varnish_submit */
 
-static int varnish_submit_gauge(const char *plugin_instance, /* {{{ */
+static int varnish_submit_gauge(const user_config_t *conf, /* {{{ */
                                 const char *category, const char *type,
                                 const char *type_instance,
                                 uint64_t gauge_value) {
-  return varnish_submit(plugin_instance, category, NULL, type, type_instance,
-                        (value_t){
-                            .gauge = (gauge_t)gauge_value,
-                        });
+  return varnish_submit(conf, category, NULL, type, type_instance,
+                        DS_TYPE_GAUGE, gauge_value);
 } /* }}} int varnish_submit_gauge */
 
 #if HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
 static int
-varnish_submit_gauge_with_target(const char *plugin_instance, /* {{{ */
+varnish_submit_gauge_with_target(const user_config_t *conf, /* {{{ */
                                  const char *category, const char *target,
                                  const char *type, const char *type_instance,
                                  uint64_t gauge_value) {
-
-  return varnish_submit(plugin_instance, category, target, type, type_instance,
-                        (value_t){
-                            .gauge = (gauge_t)gauge_value,
-                        });
+  return varnish_submit(conf, category, target, type, type_instance,
+                        DS_TYPE_GAUGE, gauge_value);
 } /* }}} int varnish_submit_gauge_with_target */
 #endif
 
-static int varnish_submit_derive(const char *plugin_instance, /* {{{ */
+static int varnish_submit_derive(const user_config_t *conf, /* {{{ */
                                  const char *category, const char *type,
                                  const char *type_instance,
                                  uint64_t derive_value) {
-  return varnish_submit(plugin_instance, category, NULL, type, type_instance,
-                        (value_t){
-                            .derive = (derive_t)derive_value,
-                        });
+  return varnish_submit(conf, category, NULL, type, type_instance,
+                        DS_TYPE_DERIVE, derive_value);
 } /* }}} int varnish_submit_derive */
 
 #if HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
 static int
-varnish_submit_derive_with_target(const char *plugin_instance, /* {{{ */
+varnish_submit_derive_with_target(const user_config_t *conf, /* {{{ */
                                   const char *category, const char *target,
                                   const char *type, const char *type_instance,
                                   uint64_t derive_value) {
-  return varnish_submit(plugin_instance, category, target, type, type_instance,
-                        (value_t){
-                            .derive = (derive_t)derive_value,
-                        });
+  return varnish_submit(conf, category, target, type, type_instance,
+                        DS_TYPE_DERIVE, derive_value);
 } /* }}} int varnish_submit_derive_with_target */
 #endif
 
@@ -257,43 +320,47 @@ static int varnish_monitor(void *priv,
 #endif
 
   val = *(const volatile uint64_t *)pt->ptr;
+#if HAVE_VARNISH_V5 || HAVE_VARNISH_V6
+  if ((conf->plan != NULL) && conf->plan->resolve)
+    conf->plan->resolving = pt->ptr;
+#endif
 
   if (conf->collect_cache) {
     if (strcmp(name, "cache_hit") == 0)
-      return varnish_submit_derive(conf->instance, "cache", "cache_result",
+      return varnish_submit_derive(conf, "cache", "cache_result",
                                    "hit", val);
     else if (strcmp(name, "cache_miss") == 0)
-      return varnish_submit_derive(conf->instance, "cache", "cache_result",
+      return varnish_submit_derive(conf, "cache", "cache_result",
                                    "miss", val);
     else if (strcmp(name, "cache_hitpass") == 0)
-      return varnish_submit_derive(conf->instance, "cache", "cache_result",
+      return varnish_submit_derive(conf, "cache", "cache_result",
                                    "hitpass", val);
 #if HAVE_VARNISH_V6
     else if (strcmp(name, "cache_hit_grace") == 0)
-      return varnish_submit_derive(conf->instance, "cache", "cache_result",
+      return varnish_submit_derive(conf, "cache", "cache_result",
                                    "hit_grace", val);
     else if (strcmp(name, "cache_hitmiss") == 0)
-      return varnish_submit_derive(conf->instance, "cache", "cache_result",
+      return varnish_submit_derive(conf, "cache", "cache_result",
                                    "hitmiss", val);
 #endif
   }
 
   if (conf->collect_connections) {
     if (strcmp(name, "client_conn") == 0)
-      return varnish_submit_derive(conf->instance, "connections", "connections",
+      return varnish_submit_derive(conf, "connections", "connections",
                                    "accepted", val);
     else if (strcmp(name, "client_drop") == 0)
-      return varnish_submit_derive(conf->instance, "connections", "connections",
+      return varnish_submit_derive(conf, "connections", "connections",
                                    "dropped", val);
     else if (strcmp(name, "client_req") == 0)
-      return varnish_submit_derive(conf->instance, "connections", "connections",
+      return varnish_submit_derive(conf, "connections", "connections",
                                    "received", val);
 #if HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
     else if (strcmp(name, "client_req_400") == 0)
-      return varnish_submit_derive(conf->instance, "connections", "connections",
+      return varnish_submit_derive(conf, "connections", "connections",
                                    "error_400", val);
     else if (strcmp(name, "client_req_417") == 0)
-      return varnish_submit_derive(conf->instance, "connections", "connections",
+      return varnish_submit_derive(conf, "connections", "connections",
                                    "error_417", val);
 #endif
   }
@@ -301,178 +368,178 @@ static int varnish_monitor(void *priv,
 #ifdef HAVE_VARNISH_V3
   if (conf->collect_dirdns) {
     if (strcmp(name, "dir_dns_lookups") == 0)
-      return varnish_submit_derive(conf->instance, "dirdns", "cache_operation",
+      return varnish_submit_derive(conf, "dirdns", "cache_operation",
                                    "lookups", val);
     else if (strcmp(name, "dir_dns_failed") == 0)
-      return varnish_submit_derive(conf->instance, "dirdns", "cache_result",
+      return varnish_submit_derive(conf, "dirdns", "cache_result",
                                    "failed", val);
     else if (strcmp(name, "dir_dns_hit") == 0)
-      return varnish_submit_derive(conf->instance, "dirdns", "cache_result",
+      return varnish_submit_derive(conf, "dirdns", "cache_result",
                                    "hits", val);
     else if (strcmp(name, "dir_dns_cache_full") == 0)
-      return varnish_submit_derive(conf->instance, "dirdns", "cache_result",
+      return varnish_submit_derive(conf, "dirdns", "cache_result",
                                    "cache_full", val);
   }
 #endif
 
   if (conf->collect_esi) {
     if (strcmp(name, "esi_errors") == 0)
-      return varnish_submit_derive(conf->instance, "esi", "total_operations",
+      return varnish_submit_derive(conf, "esi", "total_operations",
                                    "error", val);
     else if (strcmp(name, "esi_parse") == 0)
-      return varnish_submit_derive(conf->instance, "esi", "total_operations",
+      return varnish_submit_derive(conf, "esi", "total_operations",
                                    "parsed", val);
     else if (strcmp(name, "esi_warnings") == 0)
-      return varnish_submit_derive(conf->instance, "esi", "total_operations",
+      return varnish_submit_derive(conf, "esi", "total_operations",
                                    "warning", val);
     else if (strcmp(name, "esi_maxdepth") == 0)
-      return varnish_submit_derive(conf->instance, "esi", "total_operations",
+      return varnish_submit_derive(conf, "esi", "total_operations",
                                    "max_depth", val);
   }
 
   if (conf->collect_backend) {
     if (strcmp(name, "backend_conn") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
+      return varnish_submit_derive(conf, "backend", "connections",
                                    "success", val);
     else if (strcmp(name, "backend_unhealthy") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
+      return varnish_submit_derive(conf, "backend", "connections",
                                    "not-attempted", val);
     else if (strcmp(name, "backend_busy") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
+      return varnish_submit_derive(conf, "backend", "connections",
                                    "too-many", val);
     else if (strcmp(name, "backend_fail") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
+      return varnish_submit_derive(conf, "backend", "connections",
                                    "failures", val);
     else if (strcmp(name, "backend_reuse") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
+      return varnish_submit_derive(conf, "backend", "connections",
                                    "reuses", val);
     else if (strcmp(name, "backend_toolate") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
+      return varnish_submit_derive(conf, "backend", "connections",
                                    "was-closed", val);
     else if (strcmp(name, "backend_recycle") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
+      return varnish_submit_derive(conf, "backend", "connections",
                                    "recycled", val);
     else if (strcmp(name, "backend_unused") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
+      return varnish_submit_derive(conf, "backend", "connections",
                                    "unused", val);
     else if (strcmp(name, "backend_retry") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
+      return varnish_submit_derive(conf, "backend", "connections",
                                    "retries", val);
     else if (strcmp(name, "backend_req") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "http_requests",
+      return varnish_submit_derive(conf, "backend", "http_requests",
                                    "requests", val);
     else if (strcmp(name, "n_backend") == 0)
-      return varnish_submit_gauge(conf->instance, "backend", "backends",
+      return varnish_submit_gauge(conf, "backend", "backends",
                                   "n_backends", val);
   }
 
   if (conf->collect_fetch) {
     if (strcmp(name, "fetch_head") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
+      return varnish_submit_derive(conf, "fetch", "http_requests",
                                    "head", val);
     else if (strcmp(name, "fetch_length") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
+      return varnish_submit_derive(conf, "fetch", "http_requests",
                                    "length", val);
     else if (strcmp(name, "fetch_chunked") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
+      return varnish_submit_derive(conf, "fetch", "http_requests",
                                    "chunked", val);
     else if (strcmp(name, "fetch_eof") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
+      return varnish_submit_derive(conf, "fetch", "http_requests",
                                    "eof", val);
     else if (strcmp(name, "fetch_bad") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
+      return varnish_submit_derive(conf, "fetch", "http_requests",
                                    "bad_headers", val);
     else if (strcmp(name, "fetch_close") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
+      return varnish_submit_derive(conf, "fetch", "http_requests",
                                    "close", val);
     else if (strcmp(name, "fetch_oldhttp") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
+      return varnish_submit_derive(conf, "fetch", "http_requests",
                                    "oldhttp", val);
     else if (strcmp(name, "fetch_zero") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
+      return varnish_submit_derive(conf, "fetch", "http_requests",
                                    "zero", val);
     else if (strcmp(name, "fetch_failed") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
+      return varnish_submit_derive(conf, "fetch", "http_requests",
                                    "failed", val);
     else if (strcmp(name, "fetch_1xx") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
+      return varnish_submit_derive(conf, "fetch", "http_requests",
                                    "no_body_1xx", val);
     else if (strcmp(name, "fetch_204") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
+      return varnish_submit_derive(conf, "fetch", "http_requests",
                                    "no_body_204", val);
     else if (strcmp(name, "fetch_304") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
+      return varnish_submit_derive(conf, "fetch", "http_requests",
                                    "no_body_304", val);
 #if HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
     else if (strcmp(name, "fetch_no_thread") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
+      return varnish_submit_derive(conf, "fetch", "http_requests",
                                    "no_thread", val);
     else if (strcmp(name, "fetch_none") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
+      return varnish_submit_derive(conf, "fetch", "http_requests",
                                    "none", val);
     else if (strcmp(name, "busy_sleep") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
+      return varnish_submit_derive(conf, "fetch", "http_requests",
                                    "busy_sleep", val);
     else if (strcmp(name, "busy_wakeup") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
+      return varnish_submit_derive(conf, "fetch", "http_requests",
                                    "busy_wakeup", val);
 #endif
   }
 
   if (conf->collect_hcb) {
     if (strcmp(name, "hcb_nolock") == 0)
-      return varnish_submit_derive(conf->instance, "hcb", "cache_operation",
+      return varnish_submit_derive(conf, "hcb", "cache_operation",
                                    "lookup_nolock", val);
     else if (strcmp(name, "hcb_lock") == 0)
-      return varnish_submit_derive(conf->instance, "hcb", "cache_operation",
+      return varnish_submit_derive(conf, "hcb", "cache_operation",
                                    "lookup_lock", val);
     else if (strcmp(name, "hcb_insert") == 0)
-      return varnish_submit_derive(conf->instance, "hcb", "cache_operation",
+      return varnish_submit_derive(conf, "hcb", "cache_operation",
                                    "insert", val);
   }
 
   if (conf->collect_objects) {
     if (strcmp(name, "n_expired") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
+      return varnish_submit_derive(conf, "objects", "total_objects",
                                    "expired", val);
     else if (strcmp(name, "n_lru_nuked") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
+      return varnish_submit_derive(conf, "objects", "total_objects",
                                    "lru_nuked", val);
     else if (strcmp(name, "n_lru_saved") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
+      return varnish_submit_derive(conf, "objects", "total_objects",
                                    "lru_saved", val);
     else if (strcmp(name, "n_lru_moved") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
+      return varnish_submit_derive(conf, "objects", "total_objects",
                                    "lru_moved", val);
 #if HAVE_VARNISH_V6
     else if (strcmp(name, "n_lru_limited") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
+      return varnish_submit_derive(conf, "objects", "total_objects",
                                    "lru_limited", val);
 #endif
     else if (strcmp(name, "n_deathrow") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
+      return varnish_submit_derive(conf, "objects", "total_objects",
                                    "deathrow", val);
     else if (strcmp(name, "losthdr") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
+      return varnish_submit_derive(conf, "objects", "total_objects",
                                    "header_overflow", val);
     else if (strcmp(name, "n_obj_purged") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
+      return varnish_submit_derive(conf, "objects", "total_objects",
                                    "purged", val);
     else if (strcmp(name, "n_objsendfile") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
+      return varnish_submit_derive(conf, "objects", "total_objects",
                                    "sent_sendfile", val);
     else if (strcmp(name, "n_objwrite") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
+      return varnish_submit_derive(conf, "objects", "total_objects",
                                    "sent_write", val);
     else if (strcmp(name, "n_objoverflow") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
+      return varnish_submit_derive(conf, "objects", "total_objects",
                                    "workspace_overflow", val);
 #if HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
     else if (strcmp(name, "exp_mailed") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
+      return varnish_submit_gauge(conf, "struct", "objects",
                                   "exp_mailed", val);
     else if (strcmp(name, "exp_received") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
+      return varnish_submit_gauge(conf, "struct", "objects",
                                   "exp_received", val);
 #endif
   }
@@ -480,139 +547,139 @@ static int varnish_monitor(void *priv,
 #if HAVE_VARNISH_V3
   if (conf->collect_ban) {
     if (strcmp(name, "n_ban") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
+      return varnish_submit_derive(conf, "ban", "total_operations",
                                    "total", val);
     else if (strcmp(name, "n_ban_add") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
+      return varnish_submit_derive(conf, "ban", "total_operations",
                                    "added", val);
     else if (strcmp(name, "n_ban_retire") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
+      return varnish_submit_derive(conf, "ban", "total_operations",
                                    "deleted", val);
     else if (strcmp(name, "n_ban_obj_test") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
+      return varnish_submit_derive(conf, "ban", "total_operations",
                                    "objects_tested", val);
     else if (strcmp(name, "n_ban_re_test") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
+      return varnish_submit_derive(conf, "ban", "total_operations",
                                    "regexps_tested", val);
     else if (strcmp(name, "n_ban_dups") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
+      return varnish_submit_derive(conf, "ban", "total_operations",
                                    "duplicate", val);
   }
 #endif
 #if HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
   if (conf->collect_ban) {
     if (strcmp(name, "bans") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
+      return varnish_submit_derive(conf, "ban", "total_operations",
                                    "total", val);
     else if (strcmp(name, "bans_added") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
+      return varnish_submit_derive(conf, "ban", "total_operations",
                                    "added", val);
     else if (strcmp(name, "bans_obj") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
+      return varnish_submit_derive(conf, "ban", "total_operations",
                                    "obj", val);
     else if (strcmp(name, "bans_req") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
+      return varnish_submit_derive(conf, "ban", "total_operations",
                                    "req", val);
     else if (strcmp(name, "bans_completed") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
+      return varnish_submit_derive(conf, "ban", "total_operations",
                                    "completed", val);
     else if (strcmp(name, "bans_deleted") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
+      return varnish_submit_derive(conf, "ban", "total_operations",
                                    "deleted", val);
     else if (strcmp(name, "bans_tested") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
+      return varnish_submit_derive(conf, "ban", "total_operations",
                                    "tested", val);
     else if (strcmp(name, "bans_dups") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
+      return varnish_submit_derive(conf, "ban", "total_operations",
                                    "duplicate", val);
     else if (strcmp(name, "bans_tested") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
+      return varnish_submit_derive(conf, "ban", "total_operations",
                                    "tested", val);
     else if (strcmp(name, "bans_lurker_contention") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
+      return varnish_submit_derive(conf, "ban", "total_operations",
                                    "lurker_contention", val);
     else if (strcmp(name, "bans_lurker_obj_killed") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
+      return varnish_submit_derive(conf, "ban", "total_operations",
                                    "lurker_obj_killed", val);
     else if (strcmp(name, "bans_lurker_tested") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
+      return varnish_submit_derive(conf, "ban", "total_operations",
                                    "lurker_tested", val);
     else if (strcmp(name, "bans_lurker_tests_tested") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
+      return varnish_submit_derive(conf, "ban", "total_operations",
                                    "lurker_tests_tested", val);
     else if (strcmp(name, "bans_obj_killed") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
+      return varnish_submit_derive(conf, "ban", "total_operations",
                                    "obj_killed", val);
     else if (strcmp(name, "bans_persisted_bytes") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_bytes",
+      return varnish_submit_derive(conf, "ban", "total_bytes",
                                    "persisted_bytes", val);
     else if (strcmp(name, "bans_persisted_fragmentation") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_bytes",
+      return varnish_submit_derive(conf, "ban", "total_bytes",
                                    "persisted_fragmentation", val);
     else if (strcmp(name, "bans_tests_tested") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
+      return varnish_submit_derive(conf, "ban", "total_operations",
                                    "tests_tested", val);
   }
 #endif
 
   if (conf->collect_session) {
     if (strcmp(name, "sess_closed") == 0)
-      return varnish_submit_derive(conf->instance, "session",
+      return varnish_submit_derive(conf, "session",
                                    "total_operations", "closed", val);
     else if (strcmp(name, "sess_pipeline") == 0)
-      return varnish_submit_derive(conf->instance, "session",
+      return varnish_submit_derive(conf, "session",
                                    "total_operations", "pipeline", val);
     else if (strcmp(name, "sess_readahead") == 0)
-      return varnish_submit_derive(conf->instance, "session",
+      return varnish_submit_derive(conf, "session",
                                    "total_operations", "readahead", val);
     else if (strcmp(name, "sess_conn") == 0)
-      return varnish_submit_derive(conf->instance, "session",
+      return varnish_submit_derive(conf, "session",
                                    "total_operations", "accepted", val);
     else if (strcmp(name, "sess_drop") == 0)
-      return varnish_submit_derive(conf->instance, "session",
+      return varnish_submit_derive(conf, "session",
                                    "total_operations", "dropped", val);
     else if (strcmp(name, "sess_fail") == 0)
-      return varnish_submit_derive(conf->instance, "session",
+      return varnish_submit_derive(conf, "session",
                                    "total_operations", "failed", val);
 #if HAVE_VARNISH_V6
     else if (strcmp(name, "sess_fail_econnaborted") == 0)
-      return varnish_submit_derive(conf->instance, "session",
+      return varnish_submit_derive(conf, "session",
                                    "total_operations", "failed_econnaborted",
                                    val);
     else if (strcmp(name, "sess_fail_eintr") == 0)
-      return varnish_submit_derive(conf->instance, "session",
+      return varnish_submit_derive(conf, "session",
                                    "total_operations", "failed_eintr", val);
     else if (strcmp(name, "sess_fail_emfile") == 0)
-      return varnish_submit_derive(conf->instance, "session",
+      return varnish_submit_derive(conf, "session",
                                    "total_operations", "failed_emfile", val);
     else if (strcmp(name, "sess_fail_ebadf") == 0)
-      return varnish_submit_derive(conf->instance, "session",
+      return varnish_submit_derive(conf, "session",
                                    "total_operations", "failed_ebadf", val);
     else if (strcmp(name, "sess_fail_enomem") == 0)
-      return varnish_submit_derive(conf->instance, "session",
+      return varnish_submit_derive(conf, "session",
                                    "total_operations", "failed_enomem", val);
     else if (strcmp(name, "sess_fail_other") == 0)
-      return varnish_submit_derive(conf->instance, "session",
+      return varnish_submit_derive(conf, "session",
                                    "total_operations", "failed_other", val);
 #endif
     else if (strcmp(name, "sess_pipe_overflow") == 0)
-      return varnish_submit_derive(conf->instance, "session",
+      return varnish_submit_derive(conf, "session",
                                    "total_operations", "overflow", val);
     else if (strcmp(name, "sess_queued") == 0)
-      return varnish_submit_derive(conf->instance, "session",
+      return varnish_submit_derive(conf, "session",
                                    "total_operations", "queued", val);
     else if (strcmp(name, "sess_linger") == 0)
-      return varnish_submit_derive(conf->instance, "session",
+      return varnish_submit_derive(conf, "session",
                                    "total_operations", "linger", val);
     else if (strcmp(name, "sess_herd") == 0)
-      return varnish_submit_derive(conf->instance, "session",
+      return varnish_submit_derive(conf, "session",
                                    "total_operations", "herd", val);
 #if HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
     else if (strcmp(name, "sess_closed_err") == 0)
-      return varnish_submit_derive(conf->instance, "session",
+      return varnish_submit_derive(conf, "session",
                                    "total_operations", "closed_err", val);
     else if (strcmp(name, "sess_dropped") == 0)
-      return varnish_submit_derive(conf->instance, "session",
+      return varnish_submit_derive(conf, "session",
                                    "total_operations", "dropped_for_thread",
                                    val);
 #endif
@@ -620,214 +687,214 @@ static int varnish_monitor(void *priv,
 
   if (conf->collect_shm) {
     if (strcmp(name, "shm_records") == 0)
-      return varnish_submit_derive(conf->instance, "shm", "total_operations",
+      return varnish_submit_derive(conf, "shm", "total_operations",
                                    "records", val);
     else if (strcmp(name, "shm_writes") == 0)
-      return varnish_submit_derive(conf->instance, "shm", "total_operations",
+      return varnish_submit_derive(conf, "shm", "total_operations",
                                    "writes", val);
     else if (strcmp(name, "shm_flushes") == 0)
-      return varnish_submit_derive(conf->instance, "shm", "total_operations",
+      return varnish_submit_derive(conf, "shm", "total_operations",
                                    "flushes", val);
     else if (strcmp(name, "shm_cont") == 0)
-      return varnish_submit_derive(conf->instance, "shm", "total_operations",
+      return varnish_submit_derive(conf, "shm", "total_operations",
                                    "contention", val);
     else if (strcmp(name, "shm_cycles") == 0)
-      return varnish_submit_derive(conf->instance, "shm", "total_operations",
+      return varnish_submit_derive(conf, "shm", "total_operations",
                                    "cycles", val);
   }
 
   if (conf->collect_sms) {
     if (strcmp(name, "sms_nreq") == 0)
-      return varnish_submit_derive(conf->instance, "sms", "total_requests",
+      return varnish_submit_derive(conf, "sms", "total_requests",
                                    "allocator", val);
     else if (strcmp(name, "sms_nobj") == 0)
-      return varnish_submit_gauge(conf->instance, "sms", "requests",
+      return varnish_submit_gauge(conf, "sms", "requests",
                                   "outstanding", val);
     else if (strcmp(name, "sms_nbytes") == 0)
-      return varnish_submit_gauge(conf->instance, "sms", "bytes", "outstanding",
+      return varnish_submit_gauge(conf, "sms", "bytes", "outstanding",
                                   val);
     else if (strcmp(name, "sms_balloc") == 0)
-      return varnish_submit_derive(conf->instance, "sms", "total_bytes",
+      return varnish_submit_derive(conf, "sms", "total_bytes",
                                    "allocated", val);
     else if (strcmp(name, "sms_bfree") == 0)
-      return varnish_submit_derive(conf->instance, "sms", "total_bytes", "free",
+      return varnish_submit_derive(conf, "sms", "total_bytes", "free",
                                    val);
   }
 
   if (conf->collect_struct) {
     if (strcmp(name, "n_sess_mem") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "current_sessions",
+      return varnish_submit_gauge(conf, "struct", "current_sessions",
                                   "sess_mem", val);
     else if (strcmp(name, "n_sess") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "current_sessions",
+      return varnish_submit_gauge(conf, "struct", "current_sessions",
                                   "sess", val);
     else if (strcmp(name, "n_object") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects", "object",
+      return varnish_submit_gauge(conf, "struct", "objects", "object",
                                   val);
     else if (strcmp(name, "n_vampireobject") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
+      return varnish_submit_gauge(conf, "struct", "objects",
                                   "vampireobject", val);
     else if (strcmp(name, "n_objectcore") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
+      return varnish_submit_gauge(conf, "struct", "objects",
                                   "objectcore", val);
     else if (strcmp(name, "n_waitinglist") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
+      return varnish_submit_gauge(conf, "struct", "objects",
                                   "waitinglist", val);
     else if (strcmp(name, "n_objecthead") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
+      return varnish_submit_gauge(conf, "struct", "objects",
                                   "objecthead", val);
     else if (strcmp(name, "n_smf") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects", "smf",
+      return varnish_submit_gauge(conf, "struct", "objects", "smf",
                                   val);
     else if (strcmp(name, "n_smf_frag") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
+      return varnish_submit_gauge(conf, "struct", "objects",
                                   "smf_frag", val);
     else if (strcmp(name, "n_smf_large") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
+      return varnish_submit_gauge(conf, "struct", "objects",
                                   "smf_large", val);
     else if (strcmp(name, "n_vbe_conn") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
+      return varnish_submit_gauge(conf, "struct", "objects",
                                   "vbe_conn", val);
   }
 
   if (conf->collect_totals) {
     if (strcmp(name, "s_sess") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_sessions",
+      return varnish_submit_derive(conf, "totals", "total_sessions",
                                    "sessions", val);
     else if (strcmp(name, "s_req") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_requests",
+      return varnish_submit_derive(conf, "totals", "total_requests",
                                    "requests", val);
     else if (strcmp(name, "s_pipe") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_operations",
+      return varnish_submit_derive(conf, "totals", "total_operations",
                                    "pipe", val);
     else if (strcmp(name, "s_pass") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_operations",
+      return varnish_submit_derive(conf, "totals", "total_operations",
                                    "pass", val);
     else if (strcmp(name, "s_fetch") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_operations",
+      return varnish_submit_derive(conf, "totals", "total_operations",
                                    "fetches", val);
     else if (strcmp(name, "s_synth") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
+      return varnish_submit_derive(conf, "totals", "total_bytes",
                                    "synth", val);
     else if (strcmp(name, "s_req_hdrbytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
+      return varnish_submit_derive(conf, "totals", "total_bytes",
                                    "req_header", val);
     else if (strcmp(name, "s_req_bodybytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
+      return varnish_submit_derive(conf, "totals", "total_bytes",
                                    "req_body", val);
     else if (strcmp(name, "s_req_protobytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
+      return varnish_submit_derive(conf, "totals", "total_bytes",
                                    "req_proto", val);
     else if (strcmp(name, "s_resp_hdrbytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
+      return varnish_submit_derive(conf, "totals", "total_bytes",
                                    "resp_header", val);
     else if (strcmp(name, "s_resp_bodybytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
+      return varnish_submit_derive(conf, "totals", "total_bytes",
                                    "resp_body", val);
     else if (strcmp(name, "s_resp_protobytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
+      return varnish_submit_derive(conf, "totals", "total_bytes",
                                    "resp_proto", val);
     else if (strcmp(name, "s_pipe_hdrbytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
+      return varnish_submit_derive(conf, "totals", "total_bytes",
                                    "pipe_header", val);
     else if (strcmp(name, "s_pipe_in") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
+      return varnish_submit_derive(conf, "totals", "total_bytes",
                                    "pipe_in", val);
     else if (strcmp(name, "s_pipe_out") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
+      return varnish_submit_derive(conf, "totals", "total_bytes",
                                    "pipe_out", val);
     else if (strcmp(name, "n_purges") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_operations",
+      return varnish_submit_derive(conf, "totals", "total_operations",
                                    "purges", val);
     else if (strcmp(name, "s_hdrbytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
+      return varnish_submit_derive(conf, "totals", "total_bytes",
                                    "header-bytes", val);
     else if (strcmp(name, "s_bodybytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
+      return varnish_submit_derive(conf, "totals", "total_bytes",
                                    "body-bytes", val);
     else if (strcmp(name, "n_gzip") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_operations",
+      return varnish_submit_derive(conf, "totals", "total_operations",
                                    "gzip", val);
     else if (strcmp(name, "n_gunzip") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_operations",
+      return varnish_submit_derive(conf, "totals", "total_operations",
                                    "gunzip", val);
   }
 
   if (conf->collect_uptime) {
     if (strcmp(name, "uptime") == 0)
-      return varnish_submit_gauge(conf->instance, "uptime", "uptime",
+      return varnish_submit_gauge(conf, "uptime", "uptime",
                                   "client_uptime", val);
   }
 
   if (conf->collect_vcl) {
     if (strcmp(name, "n_vcl") == 0)
-      return varnish_submit_gauge(conf->instance, "vcl", "vcl", "total_vcl",
+      return varnish_submit_gauge(conf, "vcl", "vcl", "total_vcl",
                                   val);
     else if (strcmp(name, "n_vcl_avail") == 0)
-      return varnish_submit_gauge(conf->instance, "vcl", "vcl", "avail_vcl",
+      return varnish_submit_gauge(conf, "vcl", "vcl", "avail_vcl",
                                   val);
     else if (strcmp(name, "n_vcl_discard") == 0)
-      return varnish_submit_gauge(conf->instance, "vcl", "vcl", "discarded_vcl",
+      return varnish_submit_gauge(conf, "vcl", "vcl", "discarded_vcl",
                                   val);
     else if (strcmp(name, "vmods") == 0)
-      return varnish_submit_gauge(conf->instance, "vcl", "objects", "vmod",
+      return varnish_submit_gauge(conf, "vcl", "objects", "vmod",
                                   val);
   }
 
   if (conf->collect_workers) {
     if (strcmp(name, "threads") == 0)
-      return varnish_submit_gauge(conf->instance, "workers", "threads",
+      return varnish_submit_gauge(conf, "workers", "threads",
                                   "worker", val);
     else if (strcmp(name, "threads_created") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_threads",
+      return varnish_submit_derive(conf, "workers", "total_threads",
                                    "created", val);
     else if (strcmp(name, "threads_failed") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_threads",
+      return varnish_submit_derive(conf, "workers", "total_threads",
                                    "failed", val);
     else if (strcmp(name, "threads_limited") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_threads",
+      return varnish_submit_derive(conf, "workers", "total_threads",
                                    "limited", val);
     else if (strcmp(name, "threads_destroyed") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_threads",
+      return varnish_submit_derive(conf, "workers", "total_threads",
                                    "dropped", val);
     else if (strcmp(name, "thread_queue_len") == 0)
-      return varnish_submit_gauge(conf->instance, "workers", "queue_length",
+      return varnish_submit_gauge(conf, "workers", "queue_length",
                                   "threads", val);
 #if HAVE_VARNISH_V2 || HAVE_VARNISH_V3 || HAVE_VARNISH_V4 || HAVE_VARNISH_V5
     else if (strcmp(name, "n_wrk") == 0)
-      return varnish_submit_gauge(conf->instance, "workers", "threads",
+      return varnish_submit_gauge(conf, "workers", "threads",
                                   "worker", val);
     else if (strcmp(name, "n_wrk_create") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_threads",
+      return varnish_submit_derive(conf, "workers", "total_threads",
                                    "created", val);
     else if (strcmp(name, "n_wrk_failed") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_threads",
+      return varnish_submit_derive(conf, "workers", "total_threads",
                                    "failed", val);
     else if (strcmp(name, "n_wrk_max") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_threads",
+      return varnish_submit_derive(conf, "workers", "total_threads",
                                    "limited", val);
     else if (strcmp(name, "n_wrk_drop") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_threads",
+      return varnish_submit_derive(conf, "workers", "total_threads",
                                    "dropped", val);
     else if (strcmp(name, "n_wrk_queue") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_requests",
+      return varnish_submit_derive(conf, "workers", "total_requests",
                                    "queued", val);
     else if (strcmp(name, "n_wrk_overflow") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_requests",
+      return varnish_submit_derive(conf, "workers", "total_requests",
                                    "overflowed", val);
     else if (strcmp(name, "n_wrk_queued") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_requests",
+      return varnish_submit_derive(conf, "workers", "total_requests",
                                    "queued", val);
     else if (strcmp(name, "n_wrk_lqueue") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_requests",
+      return varnish_submit_derive(conf, "workers", "total_requests",
                                    "queue_length", val);
 #endif
 #if HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
     else if (strcmp(name, "pools") == 0)
-      return varnish_submit_gauge(conf->instance, "workers", "pools", "pools",
+      return varnish_submit_gauge(conf, "workers", "pools", "pools",
                                   val);
     else if (strcmp(name, "busy_killed") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "http_requests",
+      return varnish_submit_derive(conf, "workers", "http_requests",
                                    "busy_killed", val);
 #endif
   }
@@ -835,17 +902,17 @@ static int varnish_monitor(void *priv,
 #if HAVE_VARNISH_V4 || HAVE_VARNISH_V5
   if (conf->collect_vsm) {
     if (strcmp(name, "vsm_free") == 0)
-      return varnish_submit_gauge(conf->instance, "vsm", "bytes", "free", val);
+      return varnish_submit_gauge(conf, "vsm", "bytes", "free", val);
     else if (strcmp(name, "vsm_used") == 0)
-      return varnish_submit_gauge(conf->instance, "vsm", "bytes", "used", val);
+      return varnish_submit_gauge(conf, "vsm", "bytes", "used", val);
     else if (strcmp(name, "vsm_cooling") == 0)
-      return varnish_submit_gauge(conf->instance, "vsm", "bytes", "cooling",
+      return varnish_submit_gauge(conf, "vsm", "bytes", "cooling",
                                   val);
     else if (strcmp(name, "vsm_overflow") == 0)
-      return varnish_submit_gauge(conf->instance, "vsm", "bytes", "overflow",
+      return varnish_submit_gauge(conf, "vsm", "bytes", "overflow",
                                   val);
     else if (strcmp(name, "vsm_overflowed") == 0)
-      return varnish_submit_derive(conf->instance, "vsm", "total_bytes",
+      return varnish_submit_derive(conf, "vsm", "total_bytes",
                                    "overflowed", val);
   }
 #endif
@@ -854,49 +921,49 @@ static int varnish_monitor(void *priv,
   if (conf->collect_vbe) {
     /* @TODO figure out the collectd type for bitmap
     if (strcmp(name, "happy") == 0)
-      return varnish_submit_derive(conf->instance, "vbe",
+      return varnish_submit_derive(conf, "vbe",
                                    "bitmap", "happy_hprobes", val);
     */
     if (strcmp(name, "bereq_hdrbytes") == 0)
-      return varnish_submit_derive_with_target(conf->instance, "vbe",
+      return varnish_submit_derive_with_target(conf, "vbe",
                                                stat_target, "total_bytes",
                                                "bereq_hdrbytes", val);
     else if (strcmp(name, "bereq_bodybytes") == 0)
-      return varnish_submit_derive_with_target(conf->instance, "vbe",
+      return varnish_submit_derive_with_target(conf, "vbe",
                                                stat_target, "total_bytes",
                                                "bereq_bodybytes", val);
     else if (strcmp(name, "bereq_protobytes") == 0)
-      return varnish_submit_derive_with_target(conf->instance, "vbe",
+      return varnish_submit_derive_with_target(conf, "vbe",
                                                stat_target, "total_bytes",
                                                "bereq_protobytes", val);
     else if (strcmp(name, "beresp_hdrbytes") == 0)
-      return varnish_submit_derive_with_target(conf->instance, "vbe",
+      return varnish_submit_derive_with_target(conf, "vbe",
                                                stat_target, "total_bytes",
                                                "beresp_hdrbytes", val);
     else if (strcmp(name, "beresp_bodybytes") == 0)
-      return varnish_submit_derive_with_target(conf->instance, "vbe",
+      return varnish_submit_derive_with_target(conf, "vbe",
                                                stat_target, "total_bytes",
                                                "beresp_bodybytes", val);
     else if (strcmp(name, "beresp_protobytes") == 0)
-      return varnish_submit_derive_with_target(conf->instance, "vbe",
+      return varnish_submit_derive_with_target(conf, "vbe",
                                                stat_target, "total_bytes",
                                                "beresp_protobytes", val);
     else if (strcmp(name, "pipe_hdrbytes") == 0)
-      return varnish_submit_derive_with_target(conf->instance, "vbe",
+      return varnish_submit_derive_with_target(conf, "vbe",
                                                stat_target, "total_bytes",
                                                "pipe_hdrbytes", val);
     else if (strcmp(name, "pipe_out") == 0)
       return varnish_submit_derive_with_target(
-          conf->instance, "vbe", stat_target, "total_bytes", "pipe_out", val);
+          conf, "vbe", stat_target, "total_bytes", "pipe_out", val);
     else if (strcmp(name, "pipe_in") == 0)
       return varnish_submit_derive_with_target(
-          conf->instance, "vbe", stat_target, "total_bytes", "pipe_in", val);
+          conf, "vbe", stat_target, "total_bytes", "pipe_in", val);
     else if (strcmp(name, "conn") == 0)
       return varnish_submit_derive_with_target(
-          conf->instance, "vbe", stat_target, "connections", "c_conns", val);
+          conf, "vbe", stat_target, "connections", "c_conns", val);
     else if (strcmp(name, "req") == 0)
       return varnish_submit_derive_with_target(
-          conf->instance, "vbe", stat_target, "http_requests", "b_reqs", val);
+          conf, "vbe", stat_target, "http_requests", "b_reqs", val);
   }
 
   /* All Stevedores support these counters */
@@ -911,31 +978,31 @@ static int varnish_monitor(void *priv,
       strncpy(category, "mse", 4);
 
     if (strcmp(name, "c_req") == 0)
-      return varnish_submit_derive_with_target(conf->instance, category,
+      return varnish_submit_derive_with_target(conf, category,
                                                stat_target, "total_operations",
                                                "alloc_req", val);
     else if (strcmp(name, "c_fail") == 0)
-      return varnish_submit_derive_with_target(conf->instance, category,
+      return varnish_submit_derive_with_target(conf, category,
                                                stat_target, "total_operations",
                                                "alloc_fail", val);
     else if (strcmp(name, "c_bytes") == 0)
-      return varnish_submit_derive_with_target(conf->instance, category,
+      return varnish_submit_derive_with_target(conf, category,
                                                stat_target, "total_bytes",
                                                "bytes_allocated", val);
     else if (strcmp(name, "c_freed") == 0)
-      return varnish_submit_derive_with_target(conf->instance, category,
+      return varnish_submit_derive_with_target(conf, category,
                                                stat_target, "total_bytes",
                                                "bytes_freed", val);
     else if (strcmp(name, "g_alloc") == 0)
-      return varnish_submit_derive_with_target(conf->instance, category,
+      return varnish_submit_derive_with_target(conf, category,
                                                stat_target, "total_operations",
                                                "alloc_outstanding", val);
     else if (strcmp(name, "g_bytes") == 0)
-      return varnish_submit_gauge_with_target(conf->instance, category,
+      return varnish_submit_gauge_with_target(conf, category,
                                               stat_target, "bytes",
                                               "bytes_outstanding", val);
     else if (strcmp(name, "g_space") == 0)
-      return varnish_submit_gauge_with_target(conf->instance, category,
+      return varnish_submit_gauge_with_target(conf, category,
                                               stat_target, "bytes",
                                               "bytes_available", val);
   }
@@ -944,25 +1011,25 @@ static int varnish_monitor(void *priv,
   /* No SMA specific counters */
   if (conf->collect_mse) {
     if (strcmp(name, "c_fail_malloc") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
+      return varnish_submit_derive(conf, "mse", "total_operations",
                                    "alloc_fail_malloc", val);
     else if (strcmp(name, "n_lru_nuked") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_objects",
+      return varnish_submit_derive(conf, "mse", "total_objects",
                                    "lru_nuked", val);
     else if (strcmp(name, "n_lru_moved") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_objects",
+      return varnish_submit_derive(conf, "mse", "total_objects",
                                    "lru_moved", val);
     else if (strcmp(name, "n_vary") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_objects",
+      return varnish_submit_derive(conf, "mse", "total_objects",
                                    "vary_headers", val);
     else if (strcmp(name, "c_memcache_hit") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
+      return varnish_submit_derive(conf, "mse", "total_operations",
                                    "memcache_hit", val);
     else if (strcmp(name, "c_memcache_miss") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
+      return varnish_submit_derive(conf, "mse", "total_operations",
                                    "memcache_miss", val);
     else if (strcmp(name, "g_ykey_keys") == 0)
-      return varnish_submit_gauge(conf->instance, "mse", "objects", "ykey",
+      return varnish_submit_gauge(conf, "mse", "objects", "ykey",
                                   val);
   }
 #endif
@@ -970,176 +1037,176 @@ static int varnish_monitor(void *priv,
   /* No SMA specific counters */
   if (conf->collect_smf) {
     if (strcmp(name, "g_smf") == 0)
-      return varnish_submit_gauge(conf->instance, "smf", "objects",
+      return varnish_submit_gauge(conf, "smf", "objects",
                                   "n_struct_smf", val);
     else if (strcmp(name, "g_smf_frag") == 0)
-      return varnish_submit_gauge(conf->instance, "smf", "objects",
+      return varnish_submit_gauge(conf, "smf", "objects",
                                   "n_small_free_smf", val);
     else if (strcmp(name, "g_smf_large") == 0)
-      return varnish_submit_gauge(conf->instance, "smf", "objects",
+      return varnish_submit_gauge(conf, "smf", "objects",
                                   "n_large_free_smf", val);
   }
 
   if (conf->collect_mgt) {
     if (strcmp(name, "uptime") == 0)
-      return varnish_submit_gauge(conf->instance, "mgt", "uptime",
+      return varnish_submit_gauge(conf, "mgt", "uptime",
                                   "mgt_proc_uptime", val);
     else if (strcmp(name, "child_start") == 0)
-      return varnish_submit_derive(conf->instance, "mgt", "total_operations",
+      return varnish_submit_derive(conf, "mgt", "total_operations",
                                    "child_start", val);
     else if (strcmp(name, "child_exit") == 0)
-      return varnish_submit_derive(conf->instance, "mgt", "total_operations",
+      return varnish_submit_derive(conf, "mgt", "total_operations",
                                    "child_exit", val);
     else if (strcmp(name, "child_stop") == 0)
-      return varnish_submit_derive(conf->instance, "mgt", "total_operations",
+      return varnish_submit_derive(conf, "mgt", "total_operations",
                                    "child_stop", val);
     else if (strcmp(name, "child_died") == 0)
-      return varnish_submit_derive(conf->instance, "mgt", "total_operations",
+      return varnish_submit_derive(conf, "mgt", "total_operations",
                                    "child_died", val);
     else if (strcmp(name, "child_dump") == 0)
-      return varnish_submit_derive(conf->instance, "mgt", "total_operations",
+      return varnish_submit_derive(conf, "mgt", "total_operations",
                                    "child_dump", val);
     else if (strcmp(name, "child_panic") == 0)
-      return varnish_submit_derive(conf->instance, "mgt", "total_operations",
+      return varnish_submit_derive(conf, "mgt", "total_operations",
                                    "child_panic", val);
   }
 
   if (conf->collect_lck) {
     if (strcmp(name, "creat") == 0)
-      return varnish_submit_gauge(conf->instance, "lck", "objects", "created",
+      return varnish_submit_gauge(conf, "lck", "objects", "created",
                                   val);
     else if (strcmp(name, "destroy") == 0)
-      return varnish_submit_gauge(conf->instance, "lck", "objects", "destroyed",
+      return varnish_submit_gauge(conf, "lck", "objects", "destroyed",
                                   val);
     else if (strcmp(name, "locks") == 0)
-      return varnish_submit_derive(conf->instance, "lck", "total_operations",
+      return varnish_submit_derive(conf, "lck", "total_operations",
                                    "lock_ops", val);
   }
 
   if (conf->collect_mempool) {
     if (strcmp(name, "live") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "objects",
+      return varnish_submit_gauge(conf, "mempool", "objects",
                                   "in_use", val);
     else if (strcmp(name, "pool") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "objects",
+      return varnish_submit_gauge(conf, "mempool", "objects",
                                   "in_pool", val);
     else if (strcmp(name, "sz_wanted") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "bytes",
+      return varnish_submit_gauge(conf, "mempool", "bytes",
                                   "size_requested", val);
     else if (strcmp(name, "sz_actual") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "bytes",
+      return varnish_submit_gauge(conf, "mempool", "bytes",
                                   "size_allocated", val);
     else if (strcmp(name, "allocs") == 0)
-      return varnish_submit_derive(conf->instance, "mempool",
+      return varnish_submit_derive(conf, "mempool",
                                    "total_operations", "allocations", val);
     else if (strcmp(name, "frees") == 0)
-      return varnish_submit_derive(conf->instance, "mempool",
+      return varnish_submit_derive(conf, "mempool",
                                    "total_operations", "frees", val);
     else if (strcmp(name, "recycle") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "objects",
+      return varnish_submit_gauge(conf, "mempool", "objects",
                                   "recycled", val);
     else if (strcmp(name, "timeout") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "objects",
+      return varnish_submit_gauge(conf, "mempool", "objects",
                                   "timed_out", val);
     else if (strcmp(name, "toosmall") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "objects",
+      return varnish_submit_gauge(conf, "mempool", "objects",
                                   "too_small", val);
     else if (strcmp(name, "surplus") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "objects",
+      return varnish_submit_gauge(conf, "mempool", "objects",
                                   "surplus", val);
     else if (strcmp(name, "randry") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "objects",
+      return varnish_submit_gauge(conf, "mempool", "objects",
                                   "ran_dry", val);
   }
 
   if (conf->collect_mse) {
     if (strcmp(name, "c_full") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
+      return varnish_submit_derive(conf, "mse", "total_operations",
                                    "full_allocs", val);
     else if (strcmp(name, "c_truncated") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
+      return varnish_submit_derive(conf, "mse", "total_operations",
                                    "truncated_allocs", val);
     else if (strcmp(name, "c_expanded") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
+      return varnish_submit_derive(conf, "mse", "total_operations",
                                    "expanded_allocs", val);
     else if (strcmp(name, "c_failed") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
+      return varnish_submit_derive(conf, "mse", "total_operations",
                                    "failed_allocs", val);
     else if (strcmp(name, "c_bytes") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_bytes",
+      return varnish_submit_derive(conf, "mse", "total_bytes",
                                    "bytes_allocated", val);
     else if (strcmp(name, "c_freed") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_bytes",
+      return varnish_submit_derive(conf, "mse", "total_bytes",
                                    "bytes_freed", val);
     else if (strcmp(name, "g_fo_alloc") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
+      return varnish_submit_derive(conf, "mse", "total_operations",
                                    "fo_allocs_outstanding", val);
     else if (strcmp(name, "g_fo_bytes") == 0)
-      return varnish_submit_gauge(conf->instance, "mse", "bytes",
+      return varnish_submit_gauge(conf, "mse", "bytes",
                                   "fo_bytes_outstanding", val);
     else if (strcmp(name, "g_membuf_alloc") == 0)
-      return varnish_submit_gauge(conf->instance, "mse", "objects",
+      return varnish_submit_gauge(conf, "mse", "objects",
                                   "membufs_allocated", val);
     else if (strcmp(name, "g_membuf_inuse") == 0)
-      return varnish_submit_gauge(conf->instance, "mse", "objects",
+      return varnish_submit_gauge(conf, "mse", "objects",
                                   "membufs_inuse", val);
     else if (strcmp(name, "g_bans_bytes") == 0)
-      return varnish_submit_gauge(conf->instance, "mse", "bytes",
+      return varnish_submit_gauge(conf, "mse", "bytes",
                                   "persisted_banspace_used", val);
     else if (strcmp(name, "g_bans_space") == 0)
-      return varnish_submit_gauge(conf->instance, "mse", "bytes",
+      return varnish_submit_gauge(conf, "mse", "bytes",
                                   "persisted_banspace_available", val);
     else if (strcmp(name, "g_bans_persisted") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
+      return varnish_submit_derive(conf, "mse", "total_operations",
                                    "bans_persisted", val);
     else if (strcmp(name, "g_bans_lost") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
+      return varnish_submit_derive(conf, "mse", "total_operations",
                                    "bans_lost", val);
 
     /* mse seg */
     else if (strcmp(name, "g_journal_bytes") == 0)
-      return varnish_submit_gauge(conf->instance, "mse_reg", "bytes",
+      return varnish_submit_gauge(conf, "mse_reg", "bytes",
                                   "journal_bytes_used", val);
     else if (strcmp(name, "g_journal_space") == 0)
-      return varnish_submit_gauge(conf->instance, "mse_reg", "bytes",
+      return varnish_submit_gauge(conf, "mse_reg", "bytes",
                                   "journal_bytes_free", val);
 
     /* mse segagg */
     else if (strcmp(name, "g_bigspace") == 0)
-      return varnish_submit_gauge(conf->instance, "mse_segagg", "bytes",
+      return varnish_submit_gauge(conf, "mse_segagg", "bytes",
                                   "big_extents_bytes_available", val);
     else if (strcmp(name, "g_extfree") == 0)
-      return varnish_submit_gauge(conf->instance, "mse_segagg", "objects",
+      return varnish_submit_gauge(conf, "mse_segagg", "objects",
                                   "free_extents", val);
     else if (strcmp(name, "g_sparenode") == 0)
-      return varnish_submit_gauge(conf->instance, "mse_segagg", "objects",
+      return varnish_submit_gauge(conf, "mse_segagg", "objects",
                                   "spare_nodes_available", val);
     else if (strcmp(name, "g_objnode") == 0)
-      return varnish_submit_gauge(conf->instance, "mse_segagg", "objects",
+      return varnish_submit_gauge(conf, "mse_segagg", "objects",
                                   "object_nodes_in_use", val);
     else if (strcmp(name, "g_extnode") == 0)
-      return varnish_submit_gauge(conf->instance, "mse_segagg", "objects",
+      return varnish_submit_gauge(conf, "mse_segagg", "objects",
                                   "extent_nodes_in_use", val);
     else if (strcmp(name, "g_bigextfree") == 0)
-      return varnish_submit_gauge(conf->instance, "mse_segagg", "objects",
+      return varnish_submit_gauge(conf, "mse_segagg", "objects",
                                   "free_big_extents", val);
     else if (strcmp(name, "c_pruneloop") == 0)
-      return varnish_submit_derive(conf->instance, "mse_segagg",
+      return varnish_submit_derive(conf, "mse_segagg",
                                    "total_operations", "prune_loops", val);
     else if (strcmp(name, "c_pruned") == 0)
-      return varnish_submit_derive(conf->instance, "mse_segagg",
+      return varnish_submit_derive(conf, "mse_segagg",
                                    "total_objects", "pruned_objects", val);
     else if (strcmp(name, "c_spared") == 0)
-      return varnish_submit_derive(conf->instance, "mse_segagg",
+      return varnish_submit_derive(conf, "mse_segagg",
                                    "total_operations", "spared_objects", val);
     else if (strcmp(name, "c_skipped") == 0)
-      return varnish_submit_derive(conf->instance, "mse_segagg",
+      return varnish_submit_derive(conf, "mse_segagg",
                                    "total_operations", "missed_objects", val);
     else if (strcmp(name, "c_nuked") == 0)
-      return varnish_submit_derive(conf->instance, "mse_segagg",
+      return varnish_submit_derive(conf, "mse_segagg",
                                    "total_operations", "nuked_objects", val);
     else if (strcmp(name, "c_sniped") == 0)
-      return varnish_submit_derive(conf->instance, "mse_segagg",
+      return varnish_submit_derive(conf, "mse_segagg",
                                    "total_operations", "sniped_objects", val);
   }
 
@@ -1148,13 +1215,13 @@ static int varnish_monitor(void *priv,
 #if HAVE_VARNISH_V6
   if (conf->collect_goto) {
     if (strcmp(name, "goto_dns_cache_hits") == 0)
-      return varnish_submit_derive(conf->instance, "goto", "total_operations",
+      return varnish_submit_derive(conf, "goto", "total_operations",
                                    "dns_cache_hits", val);
     else if (strcmp(name, "goto_dns_lookups") == 0)
-      return varnish_submit_derive(conf->instance, "goto", "total_operations",
+      return varnish_submit_derive(conf, "goto", "total_operations",
                                    "dns_lookups", val);
     else if (strcmp(name, "goto_dns_lookup_fails") == 0)
-      return varnish_submit_derive(conf->instance, "goto", "total_operations",
+      return varnish_submit_derive(conf, "goto", "total_operations",
                                    "dns_lookup_fails", val);
   }
 #endif
@@ -1167,352 +1234,346 @@ static void varnish_monitor(const user_config_t *conf, /* {{{ */
                             const c_varnish_stats_t *stats) {
   if (conf->collect_cache) {
     /* Cache hits */
-    varnish_submit_derive(conf->instance, "cache", "cache_result", "hit",
+    varnish_submit_derive(conf, "cache", "cache_result", "hit",
                           stats->cache_hit);
     /* Cache misses */
-    varnish_submit_derive(conf->instance, "cache", "cache_result", "miss",
+    varnish_submit_derive(conf, "cache", "cache_result", "miss",
                           stats->cache_miss);
     /* Cache hits for pass */
-    varnish_submit_derive(conf->instance, "cache", "cache_result", "hitpass",
+    varnish_submit_derive(conf, "cache", "cache_result", "hitpass",
                           stats->cache_hitpass);
   }
 
   if (conf->collect_connections) {
     /* Client connections accepted */
-    varnish_submit_derive(conf->instance, "connections", "connections",
+    varnish_submit_derive(conf, "connections", "connections",
                           "accepted", stats->client_conn);
     /* Connection dropped, no sess */
-    varnish_submit_derive(conf->instance, "connections", "connections",
+    varnish_submit_derive(conf, "connections", "connections",
                           "dropped", stats->client_drop);
     /* Client requests received    */
-    varnish_submit_derive(conf->instance, "connections", "connections",
+    varnish_submit_derive(conf, "connections", "connections",
                           "received", stats->client_req);
   }
 
   if (conf->collect_esi) {
     /* ESI parse errors (unlock)   */
-    varnish_submit_derive(conf->instance, "esi", "total_operations", "error",
+    varnish_submit_derive(conf, "esi", "total_operations", "error",
                           stats->esi_errors);
     /* Objects ESI parsed (unlock) */
-    varnish_submit_derive(conf->instance, "esi", "total_operations", "parsed",
+    varnish_submit_derive(conf, "esi", "total_operations", "parsed",
                           stats->esi_parse);
   }
 
   if (conf->collect_backend) {
     /* Backend conn. success       */
-    varnish_submit_derive(conf->instance, "backend", "connections", "success",
+    varnish_submit_derive(conf, "backend", "connections", "success",
                           stats->backend_conn);
     /* Backend conn. not attempted */
-    varnish_submit_derive(conf->instance, "backend", "connections",
+    varnish_submit_derive(conf, "backend", "connections",
                           "not-attempted", stats->backend_unhealthy);
     /* Backend conn. too many      */
-    varnish_submit_derive(conf->instance, "backend", "connections", "too-many",
+    varnish_submit_derive(conf, "backend", "connections", "too-many",
                           stats->backend_busy);
     /* Backend conn. failures      */
-    varnish_submit_derive(conf->instance, "backend", "connections", "failures",
+    varnish_submit_derive(conf, "backend", "connections", "failures",
                           stats->backend_fail);
     /* Backend conn. reuses        */
-    varnish_submit_derive(conf->instance, "backend", "connections", "reuses",
+    varnish_submit_derive(conf, "backend", "connections", "reuses",
                           stats->backend_reuse);
     /* Backend conn. was closed    */
-    varnish_submit_derive(conf->instance, "backend", "connections",
+    varnish_submit_derive(conf, "backend", "connections",
                           "was-closed", stats->backend_toolate);
     /* Backend conn. recycles      */
-    varnish_submit_derive(conf->instance, "backend", "connections", "recycled",
+    varnish_submit_derive(conf, "backend", "connections", "recycled",
                           stats->backend_recycle);
     /* Backend conn. unused        */
-    varnish_submit_derive(conf->instance, "backend", "connections", "unused",
+    varnish_submit_derive(conf, "backend", "connections", "unused",
                           stats->backend_unused);
     /* Backend requests mades      */
-    varnish_submit_derive(conf->instance, "backend", "http_requests",
+    varnish_submit_derive(conf, "backend", "http_requests",
                           "requests", stats->backend_req);
     /* N backends                  */
-    varnish_submit_gauge(conf->instance, "backend", "backends", "n_backends",
+    varnish_submit_gauge(conf, "backend", "backends", "n_backends",
                          stats->n_backend);
   }
 
   if (conf->collect_fetch) {
     /* Fetch head                */
-    varnish_submit_derive(conf->instance, "fetch", "http_requests", "head",
+    varnish_submit_derive(conf, "fetch", "http_requests", "head",
                           stats->fetch_head);
     /* Fetch with length         */
-    varnish_submit_derive(conf->instance, "fetch", "http_requests", "length",
+    varnish_submit_derive(conf, "fetch", "http_requests", "length",
                           stats->fetch_length);
     /* Fetch chunked             */
-    varnish_submit_derive(conf->instance, "fetch", "http_requests", "chunked",
+    varnish_submit_derive(conf, "fetch", "http_requests", "chunked",
                           stats->fetch_chunked);
     /* Fetch EOF                 */
-    varnish_submit_derive(conf->instance, "fetch", "http_requests", "eof",
+    varnish_submit_derive(conf, "fetch", "http_requests", "eof",
                           stats->fetch_eof);
     /* Fetch bad headers         */
-    varnish_submit_derive(conf->instance, "fetch", "http_requests",
+    varnish_submit_derive(conf, "fetch", "http_requests",
                           "bad_headers", stats->fetch_bad);
     /* Fetch wanted close        */
-    varnish_submit_derive(conf->instance, "fetch", "http_requests", "close",
+    varnish_submit_derive(conf, "fetch", "http_requests", "close",
                           stats->fetch_close);
     /* Fetch pre HTTP/1.1 closed */
-    varnish_submit_derive(conf->instance, "fetch", "http_requests", "oldhttp",
+    varnish_submit_derive(conf, "fetch", "http_requests", "oldhttp",
                           stats->fetch_oldhttp);
     /* Fetch zero len            */
-    varnish_submit_derive(conf->instance, "fetch", "http_requests", "zero",
+    varnish_submit_derive(conf, "fetch", "http_requests", "zero",
                           stats->fetch_zero);
     /* Fetch failed              */
-    varnish_submit_derive(conf->instance, "fetch", "http_requests", "failed",
+    varnish_submit_derive(conf, "fetch", "http_requests", "failed",
                           stats->fetch_failed);
   }
 
   if (conf->collect_hcb) {
     /* HCB Lookups without lock */
-    varnish_submit_derive(conf->instance, "hcb", "cache_operation",
+    varnish_submit_derive(conf, "hcb", "cache_operation",
                           "lookup_nolock", stats->hcb_nolock);
     /* HCB Lookups with lock    */
-    varnish_submit_derive(conf->instance, "hcb", "cache_operation",
+    varnish_submit_derive(conf, "hcb", "cache_operation",
                           "lookup_lock", stats->hcb_lock);
     /* HCB Inserts              */
-    varnish_submit_derive(conf->instance, "hcb", "cache_operation", "insert",
+    varnish_submit_derive(conf, "hcb", "cache_operation", "insert",
                           stats->hcb_insert);
   }
 
   if (conf->collect_objects) {
     /* N expired objects             */
-    varnish_submit_derive(conf->instance, "objects", "total_objects", "expired",
+    varnish_submit_derive(conf, "objects", "total_objects", "expired",
                           stats->n_expired);
     /* N LRU nuked objects           */
-    varnish_submit_derive(conf->instance, "objects", "total_objects",
+    varnish_submit_derive(conf, "objects", "total_objects",
                           "lru_nuked", stats->n_lru_nuked);
     /* N LRU saved objects           */
-    varnish_submit_derive(conf->instance, "objects", "total_objects",
+    varnish_submit_derive(conf, "objects", "total_objects",
                           "lru_saved", stats->n_lru_saved);
     /* N LRU moved objects           */
-    varnish_submit_derive(conf->instance, "objects", "total_objects",
+    varnish_submit_derive(conf, "objects", "total_objects",
                           "lru_moved", stats->n_lru_moved);
     /* N objects on deathrow         */
-    varnish_submit_derive(conf->instance, "objects", "total_objects",
+    varnish_submit_derive(conf, "objects", "total_objects",
                           "deathrow", stats->n_deathrow);
     /* HTTP header overflows         */
-    varnish_submit_derive(conf->instance, "objects", "total_objects",
+    varnish_submit_derive(conf, "objects", "total_objects",
                           "header_overflow", stats->losthdr);
     /* Objects sent with sendfile    */
-    varnish_submit_derive(conf->instance, "objects", "total_objects",
+    varnish_submit_derive(conf, "objects", "total_objects",
                           "sent_sendfile", stats->n_objsendfile);
     /* Objects sent with write       */
-    varnish_submit_derive(conf->instance, "objects", "total_objects",
+    varnish_submit_derive(conf, "objects", "total_objects",
                           "sent_write", stats->n_objwrite);
     /* Objects overflowing workspace */
-    varnish_submit_derive(conf->instance, "objects", "total_objects",
+    varnish_submit_derive(conf, "objects", "total_objects",
                           "workspace_overflow", stats->n_objoverflow);
   }
 
   if (conf->collect_purge) {
     /* N total active purges      */
-    varnish_submit_derive(conf->instance, "purge", "total_operations", "total",
+    varnish_submit_derive(conf, "purge", "total_operations", "total",
                           stats->n_purge);
     /* N new purges added         */
-    varnish_submit_derive(conf->instance, "purge", "total_operations", "added",
+    varnish_submit_derive(conf, "purge", "total_operations", "added",
                           stats->n_purge_add);
     /* N old purges deleted       */
-    varnish_submit_derive(conf->instance, "purge", "total_operations",
+    varnish_submit_derive(conf, "purge", "total_operations",
                           "deleted", stats->n_purge_retire);
     /* N objects tested           */
-    varnish_submit_derive(conf->instance, "purge", "total_operations",
+    varnish_submit_derive(conf, "purge", "total_operations",
                           "objects_tested", stats->n_purge_obj_test);
     /* N regexps tested against   */
-    varnish_submit_derive(conf->instance, "purge", "total_operations",
+    varnish_submit_derive(conf, "purge", "total_operations",
                           "regexps_tested", stats->n_purge_re_test);
     /* N duplicate purges removed */
-    varnish_submit_derive(conf->instance, "purge", "total_operations",
+    varnish_submit_derive(conf, "purge", "total_operations",
                           "duplicate", stats->n_purge_dups);
   }
 
   if (conf->collect_session) {
     /* Session Closed     */
-    varnish_submit_derive(conf->instance, "session", "total_operations",
+    varnish_submit_derive(conf, "session", "total_operations",
                           "closed", stats->sess_closed);
     /* Session Pipeline   */
-    varnish_submit_derive(conf->instance, "session", "total_operations",
+    varnish_submit_derive(conf, "session", "total_operations",
                           "pipeline", stats->sess_pipeline);
     /* Session Read Ahead */
-    varnish_submit_derive(conf->instance, "session", "total_operations",
+    varnish_submit_derive(conf, "session", "total_operations",
                           "readahead", stats->sess_readahead);
     /* Session Linger     */
-    varnish_submit_derive(conf->instance, "session", "total_operations",
+    varnish_submit_derive(conf, "session", "total_operations",
                           "linger", stats->sess_linger);
     /* Session herd       */
-    varnish_submit_derive(conf->instance, "session", "total_operations", "herd",
+    varnish_submit_derive(conf, "session", "total_operations", "herd",
                           stats->sess_herd);
   }
 
   if (conf->collect_shm) {
     /* SHM records                 */
-    varnish_submit_derive(conf->instance, "shm", "total_operations", "records",
+    varnish_submit_derive(conf, "shm", "total_operations", "records",
                           stats->shm_records);
     /* SHM writes                  */
-    varnish_submit_derive(conf->instance, "shm", "total_operations", "writes",
+    varnish_submit_derive(conf, "shm", "total_operations", "writes",
                           stats->shm_writes);
     /* SHM flushes due to overflow */
-    varnish_submit_derive(conf->instance, "shm", "total_operations", "flushes",
+    varnish_submit_derive(conf, "shm", "total_operations", "flushes",
                           stats->shm_flushes);
     /* SHM MTX contention          */
-    varnish_submit_derive(conf->instance, "shm", "total_operations",
+    varnish_submit_derive(conf, "shm", "total_operations",
                           "contention", stats->shm_cont);
     /* SHM cycles through buffer   */
-    varnish_submit_derive(conf->instance, "shm", "total_operations", "cycles",
+    varnish_submit_derive(conf, "shm", "total_operations", "cycles",
                           stats->shm_cycles);
   }
 
   if (conf->collect_sm) {
     /* allocator requests */
-    varnish_submit_derive(conf->instance, "sm", "total_requests", "nreq",
+    varnish_submit_derive(conf, "sm", "total_requests", "nreq",
                           stats->sm_nreq);
     /* outstanding allocations */
-    varnish_submit_gauge(conf->instance, "sm", "requests", "outstanding",
+    varnish_submit_gauge(conf, "sm", "requests", "outstanding",
                          stats->sm_nobj);
     /* bytes allocated */
-    varnish_submit_derive(conf->instance, "sm", "total_bytes", "allocated",
+    varnish_submit_derive(conf, "sm", "total_bytes", "allocated",
                           stats->sm_balloc);
     /* bytes free */
-    varnish_submit_derive(conf->instance, "sm", "total_bytes", "free",
+    varnish_submit_derive(conf, "sm", "total_bytes", "free",
                           stats->sm_bfree);
   }
 
   if (conf->collect_sma) {
     /* SMA allocator requests */
-    varnish_submit_derive(conf->instance, "sma", "total_requests", "nreq",
+    varnish_submit_derive(conf, "sma", "total_requests", "nreq",
                           stats->sma_nreq);
     /* SMA outstanding allocations */
-    varnish_submit_gauge(conf->instance, "sma", "requests", "outstanding",
+    varnish_submit_gauge(conf, "sma", "requests", "outstanding",
                          stats->sma_nobj);
     /* SMA outstanding bytes */
-    varnish_submit_gauge(conf->instance, "sma", "bytes", "outstanding",
+    varnish_submit_gauge(conf, "sma", "bytes", "outstanding",
                          stats->sma_nbytes);
     /* SMA bytes allocated */
-    varnish_submit_derive(conf->instance, "sma", "total_bytes", "allocated",
+    varnish_submit_derive(conf, "sma", "total_bytes", "allocated",
                           stats->sma_balloc);
     /* SMA bytes free */
-    varnish_submit_derive(conf->instance, "sma", "total_bytes", "free",
+    varnish_submit_derive(conf, "sma", "total_bytes", "free",
                           stats->sma_bfree);
   }
 
   if (conf->collect_sms) {
     /* SMS allocator requests */
-    varnish_submit_derive(conf->instance, "sms", "total_requests", "allocator",
+    varnish_submit_derive(conf, "sms", "total_requests", "allocator",
                           stats->sms_nreq);
     /* SMS outstanding allocations */
-    varnish_submit_gauge(conf->instance, "sms", "requests", "outstanding",
+    varnish_submit_gauge(conf, "sms", "requests", "outstanding",
                          stats->sms_nobj);
     /* SMS outstanding bytes */
-    varnish_submit_gauge(conf->instance, "sms", "bytes", "outstanding",
+    varnish_submit_gauge(conf, "sms", "bytes", "outstanding",
                          stats->sms_nbytes);
     /* SMS bytes allocated */
-    varnish_submit_derive(conf->instance, "sms", "total_bytes", "allocated",
+    varnish_submit_derive(conf, "sms", "total_bytes", "allocated",
                           stats->sms_balloc);
     /* SMS bytes freed */
-    varnish_submit_derive(conf->instance, "sms", "total_bytes", "free",
+    varnish_submit_derive(conf, "sms", "total_bytes", "free",
                           stats->sms_bfree);
   }
 
   if (conf->collect_struct) {
     /* N struct sess_mem       */
-    varnish_submit_gauge(conf->instance, "struct", "current_sessions",
+    varnish_submit_gauge(conf, "struct", "current_sessions",
                          "sess_mem", stats->n_sess_mem);
     /* N struct sess           */
-    varnish_submit_gauge(conf->instance, "struct", "current_sessions", "sess",
+    varnish_submit_gauge(conf, "struct", "current_sessions", "sess",
                          stats->n_sess);
     /* N struct object         */
-    varnish_submit_gauge(conf->instance, "struct", "objects", "object",
+    varnish_submit_gauge(conf, "struct", "objects", "object",
                          stats->n_object);
     /* N struct objecthead     */
-    varnish_submit_gauge(conf->instance, "struct", "objects", "objecthead",
+    varnish_submit_gauge(conf, "struct", "objects", "objecthead",
                          stats->n_objecthead);
     /* N struct smf            */
-    varnish_submit_gauge(conf->instance, "struct", "objects", "smf",
+    varnish_submit_gauge(conf, "struct", "objects", "smf",
                          stats->n_smf);
     /* N small free smf         */
-    varnish_submit_gauge(conf->instance, "struct", "objects", "smf_frag",
+    varnish_submit_gauge(conf, "struct", "objects", "smf_frag",
                          stats->n_smf_frag);
     /* N large free smf         */
-    varnish_submit_gauge(conf->instance, "struct", "objects", "smf_large",
+    varnish_submit_gauge(conf, "struct", "objects", "smf_large",
                          stats->n_smf_large);
     /* N struct vbe_conn        */
-    varnish_submit_gauge(conf->instance, "struct", "objects", "vbe_conn",
+    varnish_submit_gauge(conf, "struct", "objects", "vbe_conn",
                          stats->n_vbe_conn);
   }
 
   if (conf->collect_totals) {
     /* Total Sessions */
-    varnish_submit_derive(conf->instance, "totals", "total_sessions",
+    varnish_submit_derive(conf, "totals", "total_sessions",
                           "sessions", stats->s_sess);
     /* Total Requests */
-    varnish_submit_derive(conf->instance, "totals", "total_requests",
+    varnish_submit_derive(conf, "totals", "total_requests",
                           "requests", stats->s_req);
     /* Total pipe */
-    varnish_submit_derive(conf->instance, "totals", "total_operations", "pipe",
+    varnish_submit_derive(conf, "totals", "total_operations", "pipe",
                           stats->s_pipe);
     /* Total pass */
-    varnish_submit_derive(conf->instance, "totals", "total_operations", "pass",
+    varnish_submit_derive(conf, "totals", "total_operations", "pass",
                           stats->s_pass);
     /* Total fetch */
-    varnish_submit_derive(conf->instance, "totals", "total_operations",
+    varnish_submit_derive(conf, "totals", "total_operations",
                           "fetches", stats->s_fetch);
     /* Total header bytes */
-    varnish_submit_derive(conf->instance, "totals", "total_bytes",
+    varnish_submit_derive(conf, "totals", "total_bytes",
                           "header-bytes", stats->s_hdrbytes);
     /* Total body byte */
-    varnish_submit_derive(conf->instance, "totals", "total_bytes", "body-bytes",
+    varnish_submit_derive(conf, "totals", "total_bytes", "body-bytes",
                           stats->s_bodybytes);
   }
 
   if (conf->collect_vcl) {
     /* N vcl total     */
-    varnish_submit_gauge(conf->instance, "vcl", "vcl", "total_vcl",
+    varnish_submit_gauge(conf, "vcl", "vcl", "total_vcl",
                          stats->n_vcl);
     /* N vcl available */
-    varnish_submit_gauge(conf->instance, "vcl", "vcl", "avail_vcl",
+    varnish_submit_gauge(conf, "vcl", "vcl", "avail_vcl",
                          stats->n_vcl_avail);
     /* N vcl discarded */
-    varnish_submit_gauge(conf->instance, "vcl", "vcl", "discarded_vcl",
+    varnish_submit_gauge(conf, "vcl", "vcl", "discarded_vcl",
                          stats->n_vcl_discard);
   }
 
   if (conf->collect_workers) {
     /* worker threads */
-    varnish_submit_gauge(conf->instance, "workers", "threads", "worker",
+    varnish_submit_gauge(conf, "workers", "threads", "worker",
                          stats->n_wrk);
     /* worker threads created */
-    varnish_submit_derive(conf->instance, "workers", "total_threads", "created",
+    varnish_submit_derive(conf, "workers", "total_threads", "created",
                           stats->n_wrk_create);
     /* worker threads not created */
-    varnish_submit_derive(conf->instance, "workers", "total_threads", "failed",
+    varnish_submit_derive(conf, "workers", "total_threads", "failed",
                           stats->n_wrk_failed);
     /* worker threads limited */
-    varnish_submit_derive(conf->instance, "workers", "total_threads", "limited",
+    varnish_submit_derive(conf, "workers", "total_threads", "limited",
                           stats->n_wrk_max);
     /* dropped work requests */
-    varnish_submit_derive(conf->instance, "workers", "total_threads", "dropped",
+    varnish_submit_derive(conf, "workers", "total_threads", "dropped",
                           stats->n_wrk_drop);
     /* queued work requests */
-    varnish_submit_derive(conf->instance, "workers", "total_requests", "queued",
+    varnish_submit_derive(conf, "workers", "total_requests", "queued",
                           stats->n_wrk_queue);
     /* overflowed work requests */
-    varnish_submit_derive(conf->instance, "workers", "total_requests",
+    varnish_submit_derive(conf, "workers", "total_requests",
                           "overflowed", stats->n_wrk_overflow);
   }
 
 } /* }}} void varnish_monitor */
 #endif
 
-#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
+#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4
 static int varnish_read(user_data_t *ud) /* {{{ */
 {
-#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4
   struct VSM_data *vd;
   bool ok;
   const c_varnish_stats_t *stats;
-#elif HAVE_VARNISH_V5 || HAVE_VARNISH_V6
-  struct vsm *vd;
-  struct vsc *vsc;
-  int vsm_status;
-#endif
 
   user_config_t *conf;
 
@@ -1523,10 +1584,6 @@ static int varnish_read(user_data_t *ud) /* {{{ */
 
   vd = VSM_New();
 
-#if HAVE_VARNISH_V5 || HAVE_VARNISH_V6
-  vsc = VSC_New();
-#endif
-
 #if HAVE_VARNISH_V3
   VSC_Setup(vd);
 #endif
@@ -1534,19 +1591,9 @@ static int varnish_read(user_data_t *ud) /* {{{ */
   if (conf->instance != NULL) {
     int status;
 
-#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4
     status = VSM_n_Arg(vd, conf->instance);
-#elif HAVE_VARNISH_V5 || HAVE_VARNISH_V6
-    status = VSM_Arg(vd, 'n', conf->instance);
-#endif
-
     if (status < 0) {
-#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4
       VSM_Delete(vd);
-#elif HAVE_VARNISH_V5 || HAVE_VARNISH_V6
-      VSC_Destroy(&vsc, vd);
-      VSM_Destroy(&vd);
-#endif
       ERROR("varnish plugin: VSM_Arg (\"%s\") failed "
             "with status %i.",
             conf->instance, status);
@@ -1559,58 +1606,148 @@ static int varnish_read(user_data_t *ud) /* {{{ */
 #elif HAVE_VARNISH_V4
   ok = (VSM_Open(vd) == 0);
 #endif
-#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4
   if (!ok) {
     VSM_Delete(vd);
     ERROR("varnish plugin: Unable to open connection.");
     return -1;
   }
-#endif
 
 #if HAVE_VARNISH_V3
   stats = VSC_Main(vd);
 #elif HAVE_VARNISH_V4
   stats = VSC_Main(vd, NULL);
 #endif
-#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4
   if (!stats) {
     VSM_Delete(vd);
     ERROR("varnish plugin: Unable to get statistics.");
     return -1;
   }
+
+#if HAVE_VARNISH_V3
+  VSC_Iter(vd, varnish_monitor, conf);
+#elif HAVE_VARNISH_V4
+  VSC_Iter(vd, NULL, varnish_monitor, conf);
 #endif
 
-#if HAVE_VARNISH_V5 || HAVE_VARNISH_V6
-  if (VSM_Attach(vd, STDERR_FILENO)) {
-    ERROR("varnish plugin: Cannot attach to varnish. %s", VSM_Error(vd));
-    VSC_Destroy(&vsc, vd);
-    VSM_Destroy(&vd);
+  VSM_Delete(vd);
+
+  return 0;
+} /* }}} */
+#elif HAVE_VARNISH_V5 || HAVE_VARNISH_V6
+static void varnish_plan_detach(varnish_plan_t *plan) /* {{{ */
+{
+  if (plan->vsc != NULL)
+    VSC_Destroy(&plan->vsc, plan->vd);
+  if (plan->vd != NULL)
+    VSM_Destroy(&plan->vd);
+  plan->points_num = 0;
+} /* }}} void varnish_plan_detach */
+
+static int varnish_plan_attach(const user_config_t *conf, /* {{{ */
+                               varnish_plan_t *plan) {
+  plan->vd = VSM_New();
+  plan->vsc = VSC_New();
+  if ((plan->vd == NULL) || (plan->vsc == NULL)) {
+    ERROR("varnish plugin: Allocating VSM/VSC handles failed.");
+    varnish_plan_detach(plan);
+    return -1;
+  }
+
+  if (conf->instance != NULL) {
+    int status = VSM_Arg(plan->vd, 'n', conf->instance);
+    if (status < 0) {
+      ERROR("varnish plugin: VSM_Arg (\"%s\") failed "
+            "with status %i.",
+            conf->instance, status);
+      varnish_plan_detach(plan);
+      return -1;
+    }
+  }
+
+  if (VSM_Attach(plan->vd, STDERR_FILENO)) {
+    ERROR("varnish plugin: Cannot attach to varnish. %s", VSM_Error(plan->vd));
+    varnish_plan_detach(plan);
     return -1;
   }
 
-  vsm_status = VSM_Status(vd);
-  if (vsm_status & ~(VSM_MGT_RUNNING | VSM_WRK_RUNNING)) {
+  return 0;
+} /* }}} int varnish_plan_attach */
+
+/* Runs the counter selection of varnish_monitor() over all points once and
+ * records the location of every selected counter. */
+static void varnish_plan_resolve(user_config_t *conf) /* {{{ */
+{
+  varnish_plan_t *plan = conf->plan;
+
+  plan->points_num = 0;
+  plan->resolve = true;
+  VSC_Iter(plan->vsc, plan->vd, varnish_monitor, conf);
+  plan->resolve = false;
+  plan->resolving = NULL;
+
+  DEBUG("varnish plugin: Resolved %zu counters of instance \"%s\".",
+        plan->points_num,
+        (conf->instance == NULL) ? "localhost" : conf->instance);
+} /* }}} void varnish_plan_resolve */
+
+static int varnish_read(user_data_t *ud) /* {{{ */
+{
+  user_config_t *conf;
+
+  if ((ud == NULL) || (ud->data == NULL))
+    return EINVAL;
+
+  conf = ud->data;
+
+  if (conf->plan == NULL) {
+    conf->plan = calloc(1, sizeof(*conf->plan));
+    if (conf->plan == NULL)
+      return ENOMEM;
+  }
+  varnish_plan_t *plan = conf->plan;
+
+  bool resolve = false;
+  if (plan->vd == NULL) {
+    if (varnish_plan_attach(conf, plan) != 0)
+      return -1;
+    resolve = true;
+  }
+
+  unsigned int vsm_status = VSM_Status(plan->vd);
+  if (!(vsm_status & (VSM_MGT_RUNNING | VSM_WRK_RUNNING))) {
     ERROR("varnish plugin: Unable to get statistics.");
-    VSC_Destroy(&vsc, vd);
-    VSM_Destroy(&vd);
+    varnish_plan_detach(plan);
     return -1;
   }
-#endif
+  if (vsm_status & (VSM_MGT_CHANGED | VSM_MGT_RESTARTED | VSM_WRK_CHANGED |
+                    VSM_WRK_RESTARTED))
+    resolve = true;
 
-#if HAVE_VARNISH_V3
-  VSC_Iter(vd, varnish_monitor, conf);
-#elif HAVE_VARNISH_V4
-  VSC_Iter(vd, NULL, varnish_monitor, conf);
-#elif HAVE_VARNISH_V5 || HAVE_VARNISH_V6
-  VSC_Iter(vsc, vd, varnish_monitor, conf);
-#endif
+  if (resolve)
+    varnish_plan_resolve(conf);
 
-#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4
-  VSM_Delete(vd);
-#elif HAVE_VARNISH_V5 || HAVE_VARNISH_V6
-  VSC_Destroy(&vsc, vd);
-  VSM_Destroy(&vd);
-#endif
+  for (size_t i = 0; i < plan->points_num; i++) {
+    varnish_point_t *point = plan->points + i;
+    uint64_t raw = *point->ptr;
+    value_t value;
+    value_list_t vl = VALUE_LIST_INIT;
+
+    if (point->ds_type == DS_TYPE_GAUGE)
+      value.gauge = (gauge_t)raw;
+    else
+      value.derive = (derive_t)raw;
+
+    vl.values = &value;
+    vl.values_len = 1;
+    sstrncpy(vl.plugin, "varnish", sizeof(vl.plugin));
+    sstrncpy(vl.plugin_instance, point->plugin_instance,
+             sizeof(vl.plugin_instance));
+    sstrncpy(vl.type, point->type, sizeof(vl.type));
+    sstrncpy(vl.type_instance, point->type_instance,
+             sizeof(vl.type_instance));
+
+    plugin_dispatch_values(&vl);
+  }
 
   return 0;
 } /* }}} */
@@ -1646,6 +1783,14 @@ static void varnish_config_free(void *ptr) /* {{{ */
   if (conf == NULL)
     return;
 
+#if HAVE_VARNISH_V5 || HAVE_VARNISH_V6
+  if (conf->plan != NULL) {
+    varnish_plan_detach(conf->plan);
+    sfree(conf->plan->points);
+    sfree(conf->plan);
+  }
+#endif
+
   sfree(conf->instance);
   sfree(conf);
 } /* }}} */
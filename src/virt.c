@@ -23,6 +23,7 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 #include "utils/ignorelist/ignorelist.h"
 #include "utils_complain.h"
@@ -87,6 +88,12 @@
 #define HAVE_DOM_REASON_PAUSED_CRASHED 1
 #endif
 
+/* virConnectGetAllDomainStats() and virDomainListGetStats() appeared in
+ * 1.2.8 */
+#if LIBVIR_CHECK_VERSION(1, 2, 8)
+#define HAVE_BULK_STATS 1
+#endif
+
 #if LIBVIR_CHECK_VERSION(1, 2, 9)
 #define HAVE_JOB_STATS 1
 #endif
@@ -108,15 +115,30 @@
 #define HAVE_DOM_REASON_POSTCOPY 1
 #endif
 
+/* The metadata-change event appeared in 3.0.0, the device-added,
+ * device-removed, disk-change and tray-change events are older. */
+#if LIBVIR_CHECK_VERSION(3, 0, 0)
+#define HAVE_DEVICE_EVENTS 1
+#endif
+
 #if LIBVIR_CHECK_VERSION(4, 10, 0)
 #define HAVE_DOM_REASON_SHUTOFF_DAEMON 1
 #endif
 #endif /* LIBVIR_CHECK_VERSION */
 
+#ifdef HAVE_DEVICE_EVENTS
+/* Domain events, besides lifecycle events, which change a domain's devices,
+ * the sources of its disks or its tag. */
+#define DEVICE_EVENTS_NUM 5
+#endif
+
 /* structure used for aggregating notification-thread data*/
 typedef struct virt_notif_thread_s {
   pthread_t event_loop_tid;
   int domain_event_cb_id;
+#ifdef HAVE_DEVICE_EVENTS
+  int device_event_cb_ids[DEVICE_EVENTS_NUM];
+#endif
   pthread_mutex_t active_mutex; /* protects 'is_active' member access*/
   bool is_active;
 } virt_notif_thread_t;
@@ -127,6 +149,9 @@ static bool persistent_notification = false;
 static bool report_block_devices = true;
 static bool report_network_interfaces = true;
 
+/* BulkStats is false by default */
+static bool bulk_stats = false;
+
 /* Thread used for handling libvirt notifications events */
 static virt_notif_thread_t notif_thread;
 
@@ -524,6 +549,10 @@ static void free_interface_devices(struct lv_read_state *state);
 static int add_interface_device(struct lv_read_state *state, virDomainPtr dom,
                                 const char *path, const char *address,
                                 unsigned int number);
+static int append_interface_device(struct lv_read_state *state,
+                                   virDomainPtr dom, const char *path,
+                                   const char *address,
+                                   const char *number_string);
 
 #define METADATA_VM_PARTITION_URI "http://ovirt.org/ovirtmap/tag/1.0"
 #define METADATA_VM_PARTITION_ELEMENT "tag"
@@ -536,8 +565,27 @@ struct lv_read_instance {
   struct lv_read_state read_state;
   char tag[PARTITION_TAG_MAX_LEN];
   size_t id;
+
+  time_t last_refresh;      /* time the lists were last refreshed */
+  uint64_t refresh_counter; /* value of lists_changed at that time */
 };
 
+/* Tag and devices parsed from a domain's XML description. The "dom" members
+ * of the device lists are not set. */
+typedef struct lv_domain_devices_s {
+  char tag[PARTITION_TAG_MAX_LEN];
+  struct lv_read_state devices;
+} lv_domain_devices_t;
+
+/* While the event loop is running, the parsed XML descriptions of running
+ * domains are kept here, keyed by UUID. The event callbacks drop the entries
+ * of domains which have changed, so that refresh_lists() only needs to fetch
+ * and parse the XML of those. Both members are protected by
+ * domain_cache_lock. */
+static c_avl_tree_t *domain_cache;
+static uint64_t lists_changed; /* incremented on every relevant event */
+static pthread_mutex_t domain_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
 struct lv_user_data {
   struct lv_read_instance inst;
   user_data_t ud;
@@ -645,10 +693,8 @@ static bool blockdevice_format_basename;
 static enum bd_field blockdevice_format = target;
 static enum if_field interface_format = if_name;
 
-/* Time that we last refreshed. */
-static time_t last_refresh = (time_t)0;
-
 static int refresh_lists(struct lv_read_instance *inst);
+static void lv_domain_cache_flush(void);
 static int register_event_impl(void);
 static int start_event_loop(virt_notif_thread_t *thread_data);
 
@@ -1451,6 +1497,18 @@ static int lv_config(oconfig_item_t *ci) {
       if (cf_util_get_boolean(c, &report_network_interfaces) != 0)
         return -1;
 
+      continue;
+    } else if (strcasecmp(c->key, "BulkStats") == 0) {
+      if (cf_util_get_boolean(c, &bulk_stats) != 0)
+        return -1;
+#ifndef HAVE_BULK_STATS
+      if (bulk_stats) {
+        WARNING(PLUGIN_NAME " plugin: 'BulkStats' requires libvirt 1.2.8 or "
+                            "newer; falling back to per-domain calls.");
+        bulk_stats = false;
+      }
+#endif
+
       continue;
     } else {
       /* Unrecognised option. */
@@ -1497,6 +1555,9 @@ static int lv_connect(void) {
         conn = NULL;
         return -1;
       }
+
+    /* Events may have been missed while disconnected. */
+    lv_domain_cache_flush();
   }
   c_release(LOG_NOTICE, &conn_complain,
             PLUGIN_NAME " plugin: Connection established.");
@@ -1543,16 +1604,18 @@ static int lv_domain_block_stats(virDomainPtr dom, const char *path,
 }
 
 #ifdef HAVE_PERF_STATS
+static void perf_param_submit(virDomainPtr dom, virTypedParameterPtr param) {
+  /* Replace '.' with '_' in event field to match other metrics' naming
+   * convention */
+  char *c = strchr(param->field, '.');
+  if (c)
+    *c = '_';
+  submit(dom, "perf", param->field, &(value_t){.derive = param->value.ul}, 1);
+}
+
 static void perf_submit(virDomainStatsRecordPtr stats) {
-  for (int i = 0; i < stats->nparams; ++i) {
-    /* Replace '.' with '_' in event field to match other metrics' naming
-     * convention */
-    char *c = strchr(stats->params[i].field, '.');
-    if (c)
-      *c = '_';
-    submit(stats->dom, "perf", stats->params[i].field,
-           &(value_t){.derive = stats->params[i].value.ul}, 1);
-  }
+  for (int i = 0; i < stats->nparams; ++i)
+    perf_param_submit(stats->dom, &stats->params[i]);
 }
 
 static int get_perf_events(virDomainPtr domain) {
@@ -2147,14 +2210,9 @@ static int get_domain_metrics(domain_t *domain) {
   return 0;
 }
 
-static int get_if_dev_stats(struct interface_device *if_dev) {
-  virDomainInterfaceStatsStruct stats = {0};
-  char *display_name = NULL;
-
-  if (!if_dev) {
-    ERROR(PLUGIN_NAME " plugin: get_if_dev_stats: NULL pointer");
-    return -1;
-  }
+static void if_dev_stats_submit(const struct interface_device *if_dev,
+                                const virDomainInterfaceStatsStruct *stats) {
+  const char *display_name = NULL;
 
   switch (interface_format) {
   case if_address:
@@ -2168,29 +2226,562 @@ static int get_if_dev_stats(struct interface_device *if_dev) {
     display_name = if_dev->path;
   }
 
+  if ((stats->rx_bytes != -1) && (stats->tx_bytes != -1))
+    submit_derive2("if_octets", (derive_t)stats->rx_bytes,
+                   (derive_t)stats->tx_bytes, if_dev->dom, display_name);
+
+  if ((stats->rx_packets != -1) && (stats->tx_packets != -1))
+    submit_derive2("if_packets", (derive_t)stats->rx_packets,
+                   (derive_t)stats->tx_packets, if_dev->dom, display_name);
+
+  if ((stats->rx_errs != -1) && (stats->tx_errs != -1))
+    submit_derive2("if_errors", (derive_t)stats->rx_errs,
+                   (derive_t)stats->tx_errs, if_dev->dom, display_name);
+
+  if ((stats->rx_drop != -1) && (stats->tx_drop != -1))
+    submit_derive2("if_dropped", (derive_t)stats->rx_drop,
+                   (derive_t)stats->tx_drop, if_dev->dom, display_name);
+}
+
+static int get_if_dev_stats(struct interface_device *if_dev) {
+  virDomainInterfaceStatsStruct stats = {0};
+
+  if (!if_dev) {
+    ERROR(PLUGIN_NAME " plugin: get_if_dev_stats: NULL pointer");
+    return -1;
+  }
+
   if (virDomainInterfaceStats(if_dev->dom, if_dev->path, &stats,
                               sizeof(stats)) != 0) {
     ERROR(PLUGIN_NAME " plugin: virDomainInterfaceStats failed");
     return -1;
   }
 
-  if ((stats.rx_bytes != -1) && (stats.tx_bytes != -1))
-    submit_derive2("if_octets", (derive_t)stats.rx_bytes,
-                   (derive_t)stats.tx_bytes, if_dev->dom, display_name);
+  if_dev_stats_submit(if_dev, &stats);
+  return 0;
+}
+
+#ifdef HAVE_BULK_STATS
+/* Per-device scratch space for one virDomainStatsRecord. */
+struct lv_bulk_block {
+  const char *name;
+  const char *path;
+  struct lv_block_stats bstats;
+  virDomainBlockInfo binfo;
+};
+
+struct lv_bulk_iface {
+  const char *name;
+  virDomainInterfaceStatsStruct stats;
+};
+
+static void init_if_stats(virDomainInterfaceStatsPtr stats) {
+  stats->rx_bytes = -1;
+  stats->rx_packets = -1;
+  stats->rx_errs = -1;
+  stats->rx_drop = -1;
+  stats->tx_bytes = -1;
+  stats->tx_packets = -1;
+  stats->tx_errs = -1;
+  stats->tx_drop = -1;
+}
+
+static int lv_param_ull(const virTypedParameter *param,
+                        unsigned long long *ret) {
+  switch (param->type) {
+  case VIR_TYPED_PARAM_INT:
+    *ret = (unsigned long long)param->value.i;
+    return 0;
+  case VIR_TYPED_PARAM_UINT:
+    *ret = (unsigned long long)param->value.ui;
+    return 0;
+  case VIR_TYPED_PARAM_LLONG:
+    *ret = (unsigned long long)param->value.l;
+    return 0;
+  case VIR_TYPED_PARAM_ULLONG:
+    *ret = param->value.ul;
+    return 0;
+  default:
+    return -1;
+  }
+}
+
+/* Splits "<prefix><index>.<field>" and returns a pointer to <field>, or NULL
+ * if the parameter name does not have this form. */
+static const char *lv_param_index(const char *name, const char *prefix,
+                                  size_t *ret_index) {
+  size_t prefix_len = strlen(prefix);
+  if (strncmp(name, prefix, prefix_len) != 0)
+    return NULL;
+
+  const char *start = name + prefix_len;
+  char *end = NULL;
+  errno = 0;
+  unsigned long idx = strtoul(start, &end, 10);
+  if ((errno != 0) || (end == start) || (*end != '.'))
+    return NULL;
+
+  *ret_index = (size_t)idx;
+  return end + 1;
+}
+
+/* Maps "balloon.*" fields onto the tag indices of memory_stats_submit().
+ * balloon.current must stay the first entry, see lv_bulk_record_submit(). */
+static const struct {
+  const char *field;
+  int tag_index;
+} lv_bulk_balloon_tags[] = {
+    {"balloon.current", 6},   {"balloon.unused", 4},
+    {"balloon.available", 5}, {"balloon.rss", 7},
+    {"balloon.usable", 8},    {"balloon.disk_caches", 10},
+};
+
+static unsigned int lv_bulk_stats_groups(void) {
+  unsigned int groups = VIR_DOMAIN_STATS_STATE | VIR_DOMAIN_STATS_CPU_TOTAL |
+                        VIR_DOMAIN_STATS_BALLOON;
+
+  if (extra_stats & (ex_stats_vcpu | ex_stats_vcpupin))
+    groups |= VIR_DOMAIN_STATS_VCPU;
+  if (report_network_interfaces)
+    groups |= VIR_DOMAIN_STATS_INTERFACE;
+  if (report_block_devices)
+    groups |= VIR_DOMAIN_STATS_BLOCK;
+#ifdef HAVE_PERF_STATS
+  if (extra_stats & ex_stats_perf)
+    groups |= VIR_DOMAIN_STATS_PERF;
+#endif
+
+  return groups;
+}
+
+static void lv_bulk_block_param(struct lv_bulk_block *b, const char *field,
+                                const virTypedParameter *param) {
+  unsigned long long value;
+
+  if (strcmp(field, "name") == 0) {
+    if (param->type == VIR_TYPED_PARAM_STRING)
+      b->name = param->value.s;
+    return;
+  } else if (strcmp(field, "path") == 0) {
+    if (param->type == VIR_TYPED_PARAM_STRING)
+      b->path = param->value.s;
+    return;
+  }
+
+  if (lv_param_ull(param, &value) != 0)
+    return;
+
+  if (strcmp(field, "rd.reqs") == 0)
+    b->bstats.bi.rd_req = (long long)value;
+  else if (strcmp(field, "rd.bytes") == 0)
+    b->bstats.bi.rd_bytes = (long long)value;
+  else if (strcmp(field, "rd.times") == 0)
+    b->bstats.rd_total_times = (long long)value;
+  else if (strcmp(field, "wr.reqs") == 0)
+    b->bstats.bi.wr_req = (long long)value;
+  else if (strcmp(field, "wr.bytes") == 0)
+    b->bstats.bi.wr_bytes = (long long)value;
+  else if (strcmp(field, "wr.times") == 0)
+    b->bstats.wr_total_times = (long long)value;
+  else if (strcmp(field, "fl.reqs") == 0)
+    b->bstats.fl_req = (long long)value;
+  else if (strcmp(field, "fl.times") == 0)
+    b->bstats.fl_total_times = (long long)value;
+  else if (strcmp(field, "allocation") == 0)
+    b->binfo.allocation = value;
+  else if (strcmp(field, "capacity") == 0)
+    b->binfo.capacity = value;
+  else if (strcmp(field, "physical") == 0)
+    b->binfo.physical = value;
+}
+
+static void lv_bulk_iface_param(struct lv_bulk_iface *n, const char *field,
+                                const virTypedParameter *param) {
+  unsigned long long value;
+
+  if (strcmp(field, "name") == 0) {
+    if (param->type == VIR_TYPED_PARAM_STRING)
+      n->name = param->value.s;
+    return;
+  }
+
+  if (lv_param_ull(param, &value) != 0)
+    return;
+
+  if (strcmp(field, "rx.bytes") == 0)
+    n->stats.rx_bytes = (long long)value;
+  else if (strcmp(field, "rx.pkts") == 0)
+    n->stats.rx_packets = (long long)value;
+  else if (strcmp(field, "rx.errs") == 0)
+    n->stats.rx_errs = (long long)value;
+  else if (strcmp(field, "rx.drop") == 0)
+    n->stats.rx_drop = (long long)value;
+  else if (strcmp(field, "tx.bytes") == 0)
+    n->stats.tx_bytes = (long long)value;
+  else if (strcmp(field, "tx.pkts") == 0)
+    n->stats.tx_packets = (long long)value;
+  else if (strcmp(field, "tx.errs") == 0)
+    n->stats.tx_errs = (long long)value;
+  else if (strcmp(field, "tx.drop") == 0)
+    n->stats.tx_drop = (long long)value;
+}
+
+/* Dispatches the block and interface entries of one record for the devices
+ * selected at the last refresh. */
+static void lv_bulk_devices_submit(struct lv_read_state *state,
+                                   virDomainPtr dom, struct lv_bulk_block *blk,
+                                   size_t nr_blk, struct lv_bulk_iface *net,
+                                   size_t nr_net) {
+  for (int i = 0; i < state->nr_block_devices; ++i) {
+    struct block_device *block_dev = &state->block_devices[i];
+    if (block_dev->dom != dom)
+      continue;
+
+    for (size_t j = 0; j < nr_blk; ++j) {
+      const char *path =
+          (blockdevice_format == source) ? blk[j].path : blk[j].name;
+      if ((path == NULL) || (strcmp(path, block_dev->path) != 0))
+        continue;
+
+      disk_block_stats_submit(&blk[j].bstats, dom, block_dev->path,
+                              &blk[j].binfo);
+      break;
+    }
+  }
+
+  for (int i = 0; i < state->nr_interface_devices; ++i) {
+    struct interface_device *if_dev = &state->interface_devices[i];
+    if (if_dev->dom != dom)
+      continue;
+
+    for (size_t j = 0; j < nr_net; ++j) {
+      if ((net[j].name == NULL) || (strcmp(net[j].name, if_dev->path) != 0))
+        continue;
+
+      if_dev_stats_submit(if_dev, &net[j].stats);
+      break;
+    }
+  }
+}
+
+static int lv_bulk_record_submit(struct lv_read_state *state,
+                                 domain_t *domain,
+                                 virDomainStatsRecordPtr rec) {
+  int dom_state = VIR_DOMAIN_NOSTATE;
+  int dom_reason = 0;
+  unsigned long long cpu_time = 0;
+  unsigned long long cpu_user = 0;
+  unsigned long long cpu_system = 0;
+  unsigned long long vcpu_current = 0;
+  gauge_t memory = NAN;
+  gauge_t balloon[STATIC_ARRAY_SIZE(lv_bulk_balloon_tags)];
+  derive_t swap_in = -1;
+  derive_t swap_out = -1;
+  derive_t min_flt = -1;
+  derive_t maj_flt = -1;
+  size_t nr_blk = 0;
+  size_t nr_net = 0;
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(balloon); i++)
+    balloon[i] = NAN;
+
+  /* First pass: scalar fields and the device counts. */
+  for (int i = 0; i < rec->nparams; ++i) {
+    virTypedParameterPtr param = &rec->params[i];
+    unsigned long long value;
+
+    if (lv_param_ull(param, &value) != 0)
+      continue;
+
+    if (strcmp(param->field, "state.state") == 0)
+      dom_state = (int)value;
+    else if (strcmp(param->field, "state.reason") == 0)
+      dom_reason = (int)value;
+    else if (strcmp(param->field, "cpu.time") == 0)
+      cpu_time = value;
+    else if (strcmp(param->field, "cpu.user") == 0)
+      cpu_user = value;
+    else if (strcmp(param->field, "cpu.system") == 0)
+      cpu_system = value;
+    else if (strcmp(param->field, "balloon.current") == 0) {
+      /* memory currently assigned to the domain, also reported as
+       * actual_balloon with ExtraStats memory */
+      memory = (gauge_t)value * 1024;
+      balloon[0] = memory;
+    } else if (strcmp(param->field, "vcpu.current") == 0)
+      vcpu_current = value;
+    else if (strcmp(param->field, "block.count") == 0)
+      nr_blk = (size_t)value;
+    else if (strcmp(param->field, "net.count") == 0)
+      nr_net = (size_t)value;
+    else if (strcmp(param->field, "balloon.swap_in") == 0)
+      swap_in = (derive_t)value;
+    else if (strcmp(param->field, "balloon.swap_out") == 0)
+      swap_out = (derive_t)value;
+    else if (strcmp(param->field, "balloon.minor_fault") == 0)
+      min_flt = (derive_t)value;
+    else if (strcmp(param->field, "balloon.major_fault") == 0)
+      maj_flt = (derive_t)value;
+    else if (strncmp(param->field, "balloon.", strlen("balloon.")) == 0) {
+      for (size_t j = 0; j < STATIC_ARRAY_SIZE(lv_bulk_balloon_tags); j++) {
+        if (strcmp(param->field, lv_bulk_balloon_tags[j].field) == 0) {
+          balloon[j] = (gauge_t)value * 1024;
+          break;
+        }
+      }
+    }
+  }
+
+  if (extra_stats & ex_stats_domain_state) {
+    value_t values[] = {
+        {.gauge = (gauge_t)dom_state},
+        {.gauge = (gauge_t)dom_reason},
+    };
+    submit(domain->ptr, "domain_state", NULL, values,
+           STATIC_ARRAY_SIZE(values));
+  }
+
+  /* Gather remaining stats only for running domains */
+  if (!domain->active || (dom_state != VIR_DOMAIN_RUNNING))
+    return 0;
+
+  if ((extra_stats & ex_stats_pcpu) && ((cpu_user > 0) || (cpu_system > 0)))
+    submit_derive2("ps_cputime", cpu_user, cpu_system, domain->ptr, NULL);
+
+  cpu_submit(domain, cpu_time);
+  /* Update cached cpuTime. It has to be done after cpu_submit */
+  domain->info.cpuTime = cpu_time;
+
+  if (!isnan(memory))
+    memory_submit(domain->ptr, memory);
+
+  if (extra_stats & ex_stats_memory) {
+    for (size_t i = 0; i < STATIC_ARRAY_SIZE(balloon); i++)
+      if (!isnan(balloon[i]))
+        memory_stats_submit(balloon[i], domain->ptr,
+                            lv_bulk_balloon_tags[i].tag_index);
+
+    if (swap_in > 0 || swap_out > 0) {
+      submit(domain->ptr, "swap_io", "in", &(value_t){.gauge = swap_in}, 1);
+      submit(domain->ptr, "swap_io", "out", &(value_t){.gauge = swap_out}, 1);
+    }
+
+    if (min_flt > 0 || maj_flt > 0) {
+      value_t values[] = {
+          {.gauge = (gauge_t)min_flt},
+          {.gauge = (gauge_t)maj_flt},
+      };
+      submit(domain->ptr, "ps_pagefaults", NULL, values,
+             STATIC_ARRAY_SIZE(values));
+    }
+  }
+
+  struct lv_bulk_block *blk = NULL;
+  struct lv_bulk_iface *net = NULL;
+  if (nr_blk > 0) {
+    blk = calloc(nr_blk, sizeof(*blk));
+    if (blk == NULL) {
+      ERROR(PLUGIN_NAME " plugin: calloc failed.");
+      return -1;
+    }
+    for (size_t i = 0; i < nr_blk; i++) {
+      init_block_stats(&blk[i].bstats);
+      init_block_info(&blk[i].binfo);
+    }
+  }
+  if (nr_net > 0) {
+    net = calloc(nr_net, sizeof(*net));
+    if (net == NULL) {
+      ERROR(PLUGIN_NAME " plugin: calloc failed.");
+      sfree(blk);
+      return -1;
+    }
+    for (size_t i = 0; i < nr_net; i++)
+      init_if_stats(&net[i].stats);
+  }
+
+  /* Second pass: per-vcpu, per-device and perf fields. */
+  for (int i = 0; i < rec->nparams; ++i) {
+    virTypedParameterPtr param = &rec->params[i];
+    const char *field;
+    size_t idx;
+
+    if ((field = lv_param_index(param->field, "block.", &idx)) != NULL) {
+      if (idx < nr_blk)
+        lv_bulk_block_param(&blk[idx], field, param);
+    } else if ((field = lv_param_index(param->field, "net.", &idx)) != NULL) {
+      if (idx < nr_net)
+        lv_bulk_iface_param(&net[idx], field, param);
+    } else if ((field = lv_param_index(param->field, "vcpu.", &idx)) != NULL) {
+      /* With vcpupin the vcpu times come from virDomainGetVcpus() below */
+      unsigned long long value;
+      if ((extra_stats & ex_stats_vcpu) && !(extra_stats & ex_stats_vcpupin) &&
+          (strcmp(field, "time") == 0) && (lv_param_ull(param, &value) == 0))
+        vcpu_submit((derive_t)value, domain->ptr, (int)idx, "virt_vcpu");
+    }
+#ifdef HAVE_PERF_STATS
+    else if ((extra_stats & ex_stats_perf) &&
+             (strncmp(param->field, "perf.", strlen("perf.")) == 0))
+      perf_param_submit(domain->ptr, param);
+#endif
+  }
+
+  lv_bulk_devices_submit(state, domain->ptr, blk, nr_blk, net, nr_net);
+  sfree(blk);
+  sfree(net);
+
+  /* Statistics that have no stats group are still fetched per domain. */
+  int status;
+  if ((extra_stats & ex_stats_vcpupin) && (vcpu_current > 0))
+    GET_STATS(get_vcpu_stats, "vcpu stats", domain->ptr,
+              (unsigned short)vcpu_current);
+
+#ifdef HAVE_FS_INFO
+  if (extra_stats & ex_stats_fs_info)
+    GET_STATS(get_fs_info, "file system info", domain->ptr);
+#endif
+
+#ifdef HAVE_DISK_ERR
+  if (extra_stats & ex_stats_disk_err)
+    GET_STATS(get_disk_err, "disk errors", domain->ptr);
+#endif
+
+#ifdef HAVE_JOB_STATS
+  if (extra_stats &
+      (ex_stats_job_stats_completed | ex_stats_job_stats_background))
+    GET_STATS(get_job_stats, "job stats", domain->ptr);
+#endif
+
+  return 0;
+}
+
+/* Records are matched to the tracked domains by UUID, since the remote
+ * driver hands out fresh virDomainPtr objects. */
+static domain_t *lv_bulk_find_domain(struct lv_read_state *state,
+                                     virDomainPtr dom, int hint) {
+  unsigned char uuid[VIR_UUID_BUFLEN];
+  unsigned char cand[VIR_UUID_BUFLEN];
+
+  if (virDomainGetUUID(dom, uuid) != 0)
+    return NULL;
+
+  if ((hint >= 0) && (hint < state->nr_domains) &&
+      (virDomainGetUUID(state->domains[hint].ptr, cand) == 0) &&
+      (memcmp(uuid, cand, sizeof(uuid)) == 0))
+    return &state->domains[hint];
+
+  for (int i = 0; i < state->nr_domains; ++i) {
+    if ((virDomainGetUUID(state->domains[i].ptr, cand) == 0) &&
+        (memcmp(uuid, cand, sizeof(uuid)) == 0))
+      return &state->domains[i];
+  }
+
+  return NULL;
+}
+
+/* Fetches the statistics of all domains of this read instance with a single
+ * virDomainListGetStats() call. Returns -1 if the caller should fall back to
+ * the per-domain calls. */
+static int lv_read_bulk(struct lv_read_state *state) {
+  if (state->nr_domains == 0)
+    return 0;
+
+  /* virDomainListGetStats requires a NULL terminated list of domains */
+  virDomainPtr *domain_array =
+      calloc(state->nr_domains + 1, sizeof(*domain_array));
+  if (domain_array == NULL) {
+    ERROR(PLUGIN_NAME " plugin: calloc failed.");
+    return -1;
+  }
+  for (int i = 0; i < state->nr_domains; ++i)
+    domain_array[i] = state->domains[i].ptr;
+
+  virDomainStatsRecordPtr *records = NULL;
+  int nr_records = virDomainListGetStats(domain_array, lv_bulk_stats_groups(),
+                                         &records, 0);
+  sfree(domain_array);
+  if (nr_records < 0) {
+    VIRT_ERROR(conn, "virDomainListGetStats");
+
+    virErrorPtr err = virGetLastError();
+    if (err && err->code == VIR_ERR_NO_SUPPORT) {
+      ERROR(PLUGIN_NAME " plugin: Disabled unsupported option: BulkStats");
+      bulk_stats = false;
+    }
+
+    return -1;
+  }
 
-  if ((stats.rx_packets != -1) && (stats.tx_packets != -1))
-    submit_derive2("if_packets", (derive_t)stats.rx_packets,
-                   (derive_t)stats.tx_packets, if_dev->dom, display_name);
+  for (int i = 0; i < nr_records; ++i) {
+    domain_t *domain = lv_bulk_find_domain(state, records[i]->dom, i);
+    if (domain == NULL)
+      continue;
 
-  if ((stats.rx_errs != -1) && (stats.tx_errs != -1))
-    submit_derive2("if_errors", (derive_t)stats.rx_errs,
-                   (derive_t)stats.tx_errs, if_dev->dom, display_name);
+    if (lv_bulk_record_submit(state, domain, records[i]) != 0)
+      ERROR(PLUGIN_NAME " plugin: failed to get metrics for domain=%s",
+            virDomainGetName(domain->ptr));
+  }
 
-  if ((stats.rx_drop != -1) && (stats.tx_drop != -1))
-    submit_derive2("if_dropped", (derive_t)stats.rx_drop,
-                   (derive_t)stats.tx_drop, if_dev->dom, display_name);
+  virDomainStatsRecordListFree(records);
   return 0;
 }
+#endif /* HAVE_BULK_STATS */
+
+static void lv_domain_devices_free(lv_domain_devices_t *devs) {
+  if (devs == NULL)
+    return;
+
+  free_block_devices(&devs->devices);
+  free_interface_devices(&devs->devices);
+  sfree(devs);
+}
+
+/* Drops all cached XML descriptions and makes all instances refresh their
+ * lists on their next read. */
+static void lv_domain_cache_flush(void) {
+  pthread_mutex_lock(&domain_cache_lock);
+  if (domain_cache != NULL) {
+    char *uuid;
+    lv_domain_devices_t *devs;
+    while (c_avl_pick(domain_cache, (void *)&uuid, (void *)&devs) == 0) {
+      sfree(uuid);
+      lv_domain_devices_free(devs);
+    }
+  }
+  lists_changed++;
+  pthread_mutex_unlock(&domain_cache_lock);
+}
+
+/* Makes all instances refresh their lists on their next read. If "reparse"
+ * is set, the domain's XML description is fetched and parsed again, too. */
+static void lv_domain_changed(virDomainPtr dom, bool reparse) {
+  char uuid[VIR_UUID_STRING_BUFLEN];
+
+  if (reparse && (virDomainGetUUIDString(dom, uuid) != 0)) {
+    /* Without the UUID the entry can't be found; start from scratch. */
+    lv_domain_cache_flush();
+    return;
+  }
+
+  pthread_mutex_lock(&domain_cache_lock);
+  if (reparse && (domain_cache != NULL)) {
+    char *key;
+    lv_domain_devices_t *devs;
+    if (c_avl_remove(domain_cache, uuid, (void *)&key, (void *)&devs) == 0) {
+      sfree(key);
+      lv_domain_devices_free(devs);
+    }
+  }
+  lists_changed++;
+  pthread_mutex_unlock(&domain_cache_lock);
+}
+
+static uint64_t lv_lists_changed(void) {
+  pthread_mutex_lock(&domain_cache_lock);
+  uint64_t ret = lists_changed;
+  pthread_mutex_unlock(&domain_cache_lock);
+  return ret;
+}
 
 static int domain_lifecycle_event_cb(__attribute__((unused)) virConnectPtr con_,
                                      virDomainPtr dom, int event, int detail,
@@ -2202,9 +2793,73 @@ static int domain_lifecycle_event_cb(__attribute__((unused)) virConnectPtr con_,
 #endif
   domain_state_submit_notif(dom, domain_state, domain_reason);
 
+  /* Suspending or resuming changes whether the domain's devices are read,
+   * all other events may also have changed its XML description. */
+  lv_domain_changed(dom, (event != VIR_DOMAIN_EVENT_SUSPENDED) &&
+                             (event != VIR_DOMAIN_EVENT_RESUMED));
+
   return 0;
 }
 
+#ifdef HAVE_DEVICE_EVENTS
+static void domain_device_event_cb(__attribute__((unused)) virConnectPtr con_,
+                                   virDomainPtr dom, const char *dev_alias,
+                                   __attribute__((unused)) void *opaque) {
+  DEBUG(PLUGIN_NAME " plugin: device %s of domain %s added or removed",
+        dev_alias, virDomainGetName(dom));
+  lv_domain_changed(dom, true);
+}
+
+/* Changing or ejecting the medium of a removable disk changes whether the
+ * disk has a source. */
+static void domain_disk_event_cb(__attribute__((unused)) virConnectPtr con_,
+                                 virDomainPtr dom,
+                                 __attribute__((unused)) const char *old_src,
+                                 __attribute__((unused)) const char *new_src,
+                                 const char *dev_alias,
+                                 __attribute__((unused)) int reason,
+                                 __attribute__((unused)) void *opaque) {
+  DEBUG(PLUGIN_NAME " plugin: medium of disk %s of domain %s changed",
+        dev_alias, virDomainGetName(dom));
+  lv_domain_changed(dom, true);
+}
+
+static void domain_tray_event_cb(__attribute__((unused)) virConnectPtr con_,
+                                 virDomainPtr dom, const char *dev_alias,
+                                 __attribute__((unused)) int reason,
+                                 __attribute__((unused)) void *opaque) {
+  DEBUG(PLUGIN_NAME " plugin: tray of disk %s of domain %s moved", dev_alias,
+        virDomainGetName(dom));
+  lv_domain_changed(dom, true);
+}
+
+static void domain_metadata_event_cb(__attribute__((unused)) virConnectPtr con_,
+                                     virDomainPtr dom,
+                                     __attribute__((unused)) int type,
+                                     __attribute__((unused)) const char *nsuri,
+                                     __attribute__((unused)) void *opaque) {
+  /* The metadata holds the domain's partition tag. */
+  lv_domain_changed(dom, true);
+}
+
+static const struct {
+  int event_id;
+  const char *name;
+  virConnectDomainEventGenericCallback cb;
+} device_events[DEVICE_EVENTS_NUM] = {
+    {VIR_DOMAIN_EVENT_ID_DEVICE_ADDED, "device-added",
+     VIR_DOMAIN_EVENT_CALLBACK(domain_device_event_cb)},
+    {VIR_DOMAIN_EVENT_ID_DEVICE_REMOVED, "device-removed",
+     VIR_DOMAIN_EVENT_CALLBACK(domain_device_event_cb)},
+    {VIR_DOMAIN_EVENT_ID_DISK_CHANGE, "disk-change",
+     VIR_DOMAIN_EVENT_CALLBACK(domain_disk_event_cb)},
+    {VIR_DOMAIN_EVENT_ID_TRAY_CHANGE, "tray-change",
+     VIR_DOMAIN_EVENT_CALLBACK(domain_tray_event_cb)},
+    {VIR_DOMAIN_EVENT_ID_METADATA_CHANGE, "metadata-change",
+     VIR_DOMAIN_EVENT_CALLBACK(domain_metadata_event_cb)},
+};
+#endif /* HAVE_DEVICE_EVENTS */
+
 static void virt_eventloop_timeout_cb(int timer ATTRIBUTE_UNUSED,
                                       void *timer_info) {}
 
@@ -2276,6 +2931,10 @@ static int virt_notif_thread_init(virt_notif_thread_t *thread_data) {
    * domain_event_cb_id to '-1'
    */
   thread_data->domain_event_cb_id = -1;
+#ifdef HAVE_DEVICE_EVENTS
+  for (size_t i = 0; i < DEVICE_EVENTS_NUM; i++)
+    thread_data->device_event_cb_ids[i] = -1;
+#endif
   pthread_mutex_lock(&thread_data->active_mutex);
   thread_data->is_active = false;
   pthread_mutex_unlock(&thread_data->active_mutex);
@@ -2294,6 +2953,18 @@ static int start_event_loop(virt_notif_thread_t *thread_data) {
     return -1;
   }
 
+#ifdef HAVE_DEVICE_EVENTS
+  for (size_t i = 0; i < DEVICE_EVENTS_NUM; i++) {
+    thread_data->device_event_cb_ids[i] = virConnectDomainEventRegisterAny(
+        conn, NULL, device_events[i].event_id, device_events[i].cb, NULL,
+        NULL);
+    if (thread_data->device_event_cb_ids[i] == -1)
+      WARNING(PLUGIN_NAME " plugin: registering the %s event callback failed, "
+                          "domain XML will be parsed on every refresh",
+              device_events[i].name);
+  }
+#endif
+
   DEBUG(PLUGIN_NAME " plugin: starting event loop");
 
   virt_notif_thread_set_active(thread_data, 1);
@@ -2303,6 +2974,15 @@ static int start_event_loop(virt_notif_thread_t *thread_data) {
     virt_notif_thread_set_active(thread_data, 0);
     virConnectDomainEventDeregisterAny(conn, thread_data->domain_event_cb_id);
     thread_data->domain_event_cb_id = -1;
+#ifdef HAVE_DEVICE_EVENTS
+    for (size_t i = 0; i < DEVICE_EVENTS_NUM; i++) {
+      if (thread_data->device_event_cb_ids[i] == -1)
+        continue;
+      virConnectDomainEventDeregisterAny(conn,
+                                         thread_data->device_event_cb_ids[i]);
+      thread_data->device_event_cb_ids[i] = -1;
+    }
+#endif
     return -1;
   }
 
@@ -2326,6 +3006,34 @@ static void stop_event_loop(virt_notif_thread_t *thread_data) {
     virConnectDomainEventDeregisterAny(conn, thread_data->domain_event_cb_id);
     thread_data->domain_event_cb_id = -1;
   }
+
+#ifdef HAVE_DEVICE_EVENTS
+  for (size_t i = 0; i < DEVICE_EVENTS_NUM; i++) {
+    if (conn != NULL && thread_data->device_event_cb_ids[i] != -1)
+      virConnectDomainEventDeregisterAny(conn,
+                                         thread_data->device_event_cb_ids[i]);
+    thread_data->device_event_cb_ids[i] = -1;
+  }
+#endif
+}
+
+/* The parsed XML descriptions may only be reused while every event that
+ * changes them is being delivered. */
+static bool lv_domain_cache_enabled(void) {
+#ifdef HAVE_DEVICE_EVENTS
+  if (persistent_notification || !virt_notif_thread_is_active(&notif_thread))
+    return false;
+
+  if (notif_thread.domain_event_cb_id == -1)
+    return false;
+  for (size_t i = 0; i < DEVICE_EVENTS_NUM; i++)
+    if (notif_thread.device_event_cb_ids[i] == -1)
+      return false;
+
+  return true;
+#else
+  return false;
+#endif
 }
 
 static int persistent_domains_state_notification(void) {
@@ -2430,7 +3138,6 @@ static int lv_read(user_data_t *ud) {
         stop_event_loop(&notif_thread);
 
       lv_disconnect();
-      last_refresh = 0;
     }
     return -1;
   }
@@ -2438,9 +3145,11 @@ static int lv_read(user_data_t *ud) {
   time_t t;
   time(&t);
 
-  /* Need to refresh domain or device lists? */
-  if ((last_refresh == (time_t)0) ||
-      ((interval > 0) && ((last_refresh + interval) <= t))) {
+  /* Need to refresh domain or device lists? Besides every RefreshInterval,
+   * this is the case whenever the event loop has seen a relevant change. */
+  uint64_t changed = lv_lists_changed();
+  if ((inst->last_refresh == (time_t)0) || (inst->refresh_counter != changed) ||
+      ((interval > 0) && ((inst->last_refresh + interval) <= t))) {
     if (refresh_lists(inst) != 0) {
       if (inst->id == 0) {
         if (!persistent_notification)
@@ -2449,7 +3158,8 @@ static int lv_read(user_data_t *ud) {
       }
       return -1;
     }
-    last_refresh = t;
+    inst->last_refresh = t;
+    inst->refresh_counter = changed;
   }
 
   /* persistent domains state notifications are handled by instance 0 */
@@ -2475,6 +3185,11 @@ static int lv_read(user_data_t *ud) {
           state->interface_devices[i].path);
 #endif
 
+#ifdef HAVE_BULK_STATS
+  if (bulk_stats && (lv_read_bulk(state) == 0))
+    return 0;
+#endif
+
   /* Get domains' metrics */
   for (int i = 0; i < state->nr_domains; ++i) {
     domain_t *dom = &state->domains[i];
@@ -2833,6 +3548,136 @@ static bool is_domain_ignored(virDomainPtr dom) {
   return false;
 }
 
+/* Fetches and parses the XML description of "dom". If "inst" is given, the
+ * devices are only parsed if that instance is in charge of the domain. */
+static lv_domain_devices_t *lv_parse_domain_devices(
+    virDomainPtr dom, const char *domname, struct lv_read_instance *inst) {
+  xmlDocPtr xml_doc = NULL;
+  xmlXPathContextPtr xpath_ctx = NULL;
+
+  lv_domain_devices_t *devs = calloc(1, sizeof(*devs));
+  if (devs == NULL) {
+    ERROR(PLUGIN_NAME " plugin: calloc failed.");
+    return NULL;
+  }
+
+  char *xml = virDomainGetXMLDesc(dom, 0);
+  if (!xml) {
+    VIRT_ERROR(conn, "virDomainGetXMLDesc");
+    goto error;
+  }
+
+  /* Yuck, XML.  Parse out the devices. */
+  xml_doc = xmlReadDoc((xmlChar *)xml, NULL, NULL, XML_PARSE_NONET);
+  if (xml_doc == NULL) {
+    VIRT_ERROR(conn, "xmlReadDoc");
+    goto error;
+  }
+
+  xpath_ctx = xmlXPathNewContext(xml_doc);
+
+  if (lv_domain_get_tag(xpath_ctx, domname, devs->tag) < 0) {
+    ERROR(PLUGIN_NAME " plugin: lv_domain_get_tag failed.");
+    goto error;
+  }
+
+  if ((inst == NULL) || lv_instance_include_domain(inst, domname, devs->tag)) {
+    /* Block devices. */
+    if (report_block_devices)
+      lv_add_block_devices(&devs->devices, NULL, domname, xpath_ctx);
+
+    /* Network interfaces. */
+    if (report_network_interfaces)
+      lv_add_network_interfaces(&devs->devices, NULL, domname, xpath_ctx);
+  }
+
+  xmlXPathFreeContext(xpath_ctx);
+  xmlFreeDoc(xml_doc);
+  sfree(xml);
+  return devs;
+
+error:
+  if (xpath_ctx)
+    xmlXPathFreeContext(xpath_ctx);
+  if (xml_doc)
+    xmlFreeDoc(xml_doc);
+  sfree(xml);
+  lv_domain_devices_free(devs);
+  return NULL;
+}
+
+/* Adds the devices of "dom" to the instance's lists, if the instance is in
+ * charge of it. */
+static void lv_apply_domain_devices(struct lv_read_instance *inst,
+                                    virDomainPtr dom, const char *domname,
+                                    const lv_domain_devices_t *devs) {
+  struct lv_read_state *state = &inst->read_state;
+
+  if (!lv_instance_include_domain(inst, domname, devs->tag))
+    return;
+
+  for (int i = 0; i < devs->devices.nr_block_devices; ++i) {
+    const struct block_device *bd = &devs->devices.block_devices[i];
+    add_block_device(state, dom, bd->path, bd->has_source);
+  }
+
+  for (int i = 0; i < devs->devices.nr_interface_devices; ++i) {
+    const struct interface_device *itf = &devs->devices.interface_devices[i];
+    append_interface_device(state, dom, itf->path, itf->address, itf->number);
+  }
+}
+
+/* Adds the devices of "dom" from the cache. Returns zero on success and
+ * ENOENT if the domain's XML description needs to be parsed. */
+static int lv_domain_cache_apply(struct lv_read_instance *inst,
+                                 virDomainPtr dom, const char *domname,
+                                 const char *uuid) {
+  lv_domain_devices_t *devs = NULL;
+
+  pthread_mutex_lock(&domain_cache_lock);
+  if ((domain_cache == NULL) ||
+      (c_avl_get(domain_cache, uuid, (void *)&devs) != 0)) {
+    pthread_mutex_unlock(&domain_cache_lock);
+    return ENOENT;
+  }
+
+  lv_apply_domain_devices(inst, dom, domname, devs);
+  pthread_mutex_unlock(&domain_cache_lock);
+  return 0;
+}
+
+/* Stores "devs" in the cache, unless an event arrived since "changed" was
+ * read: the XML description might be outdated then. On success, the cache
+ * takes ownership of "devs". */
+static int lv_domain_cache_insert(const char *uuid, lv_domain_devices_t *devs,
+                                  uint64_t changed) {
+  pthread_mutex_lock(&domain_cache_lock);
+  if (lists_changed != changed) {
+    pthread_mutex_unlock(&domain_cache_lock);
+    return EAGAIN;
+  }
+
+  if (domain_cache == NULL) {
+    domain_cache =
+        c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (domain_cache == NULL) {
+      pthread_mutex_unlock(&domain_cache_lock);
+      return ENOMEM;
+    }
+  }
+
+  char *key = strdup(uuid);
+  if ((key == NULL) || (c_avl_insert(domain_cache, key, devs) != 0)) {
+    /* Out of memory, or another instance has been faster. */
+    pthread_mutex_unlock(&domain_cache_lock);
+    sfree(key);
+    return EEXIST;
+  }
+
+  pthread_mutex_unlock(&domain_cache_lock);
+  return 0;
+}
+
 static int refresh_lists(struct lv_read_instance *inst) {
   struct lv_read_state *state = &inst->read_state;
   int n;
@@ -2852,6 +3697,8 @@ static int refresh_lists(struct lv_read_instance *inst) {
     goto end;
 #endif
 
+  bool cache_enabled = lv_domain_cache_enabled();
+
 #ifdef HAVE_LIST_ALL_DOMAINS
   virDomainPtr *domains, *domains_inactive;
   int m = virConnectListAllDomains(conn, &domains_inactive,
@@ -2939,48 +3786,22 @@ static int refresh_lists(struct lv_read_instance *inst) {
       continue;
     }
 
-    /* Get a list of devices for this domain. */
-    xmlDocPtr xml_doc = NULL;
-    xmlXPathContextPtr xpath_ctx = NULL;
-
-    char *xml = virDomainGetXMLDesc(dom, 0);
-    if (!xml) {
-      VIRT_ERROR(conn, "virDomainGetXMLDesc");
-      goto cont;
-    }
-
-    /* Yuck, XML.  Parse out the devices. */
-    xml_doc = xmlReadDoc((xmlChar *)xml, NULL, NULL, XML_PARSE_NONET);
-    if (xml_doc == NULL) {
-      VIRT_ERROR(conn, "xmlReadDoc");
-      goto cont;
-    }
-
-    xpath_ctx = xmlXPathNewContext(xml_doc);
-
-    char tag[PARTITION_TAG_MAX_LEN] = {'\0'};
-    if (lv_domain_get_tag(xpath_ctx, domname, tag) < 0) {
-      ERROR(PLUGIN_NAME " plugin: lv_domain_get_tag failed.");
-      goto cont;
-    }
-
-    if (!lv_instance_include_domain(inst, domname, tag))
-      goto cont;
-
-    /* Block devices. */
-    if (report_block_devices)
-      lv_add_block_devices(state, dom, domname, xpath_ctx);
+    /* Get a list of devices for this domain, parsing its XML description
+     * only if it is not cached. */
+    char uuid[VIR_UUID_STRING_BUFLEN];
+    bool use_cache = cache_enabled && (virDomainGetUUIDString(dom, uuid) == 0);
+    if (use_cache && (lv_domain_cache_apply(inst, dom, domname, uuid) == 0))
+      continue;
 
-    /* Network interfaces. */
-    if (report_network_interfaces)
-      lv_add_network_interfaces(state, dom, domname, xpath_ctx);
+    uint64_t changed = lv_lists_changed();
+    lv_domain_devices_t *devs =
+        lv_parse_domain_devices(dom, domname, use_cache ? NULL : inst);
+    if (devs == NULL)
+      continue;
 
-  cont:
-    if (xpath_ctx)
-      xmlXPathFreeContext(xpath_ctx);
-    if (xml_doc)
-      xmlFreeDoc(xml_doc);
-    sfree(xml);
+    lv_apply_domain_devices(inst, dom, domname, devs);
+    if (!use_cache || (lv_domain_cache_insert(uuid, devs, changed) != 0))
+      lv_domain_devices_free(devs);
   }
 
 #ifdef HAVE_LIST_ALL_DOMAINS
@@ -3080,6 +3901,16 @@ static void free_interface_devices(struct lv_read_state *state) {
 static int add_interface_device(struct lv_read_state *state, virDomainPtr dom,
                                 const char *path, const char *address,
                                 unsigned int number) {
+  char number_string[21];
+  ssnprintf(number_string, sizeof(number_string), "interface-%u", number);
+
+  return append_interface_device(state, dom, path, address, number_string);
+}
+
+static int append_interface_device(struct lv_read_state *state,
+                                   virDomainPtr dom, const char *path,
+                                   const char *address,
+                                   const char *number_string) {
 
   if ((path == NULL) || (address == NULL))
     return EINVAL;
@@ -3094,8 +3925,6 @@ static int add_interface_device(struct lv_read_state *state, virDomainPtr dom,
     return -1;
   }
 
-  char number_string[21];
-  ssnprintf(number_string, sizeof(number_string), "interface-%u", number);
   char *number_copy = strdup(number_string);
   if (!number_copy) {
     sfree(path_copy);
@@ -3150,6 +3979,10 @@ static int lv_shutdown(void) {
 
   lv_disconnect();
 
+  lv_domain_cache_flush();
+  c_avl_destroy(domain_cache);
+  domain_cache = NULL;
+
   ignorelist_free(il_domains);
   il_domains = NULL;
   ignorelist_free(il_block_devices);
@@ -3162,6 +3995,7 @@ static int lv_shutdown(void) {
 
 void module_register(void) {
   plugin_register_complex_config("virt", lv_config);
-  plugin_register_init(PLUGIN_NAME, lv_init);
+  plugin_register_init_concurrent(PLUGIN_NAME, lv_init,
+                                  /* depends_on = */ NULL);
   plugin_register_shutdown(PLUGIN_NAME, lv_shutdown);
 }
@@ -85,11 +85,67 @@ DEF_TEST(persistent_domains_state_notification) {
   return 0;
 }
 
+#ifdef HAVE_BULK_STATS
+DEF_TEST(lv_param_index) {
+  size_t idx = 0;
+
+  EXPECT_EQ_STR("rd.bytes",
+                lv_param_index("block.12.rd.bytes", "block.", &idx));
+  EXPECT_EQ_INT(12, (int)idx);
+  EXPECT_EQ_STR("name", lv_param_index("net.0.name", "net.", &idx));
+  EXPECT_EQ_INT(0, (int)idx);
+  OK(lv_param_index("block.count", "block.", &idx) == NULL);
+  OK(lv_param_index("net.0.name", "block.", &idx) == NULL);
+  OK(lv_param_index("vcpu.3", "vcpu.", &idx) == NULL);
+
+  return 0;
+}
+
+#ifdef HAVE_LIST_ALL_DOMAINS
+DEF_TEST(lv_read_bulk) {
+  if (setup() == 0) {
+    struct lv_read_state state = {0};
+
+    nr_domains = virConnectListAllDomains(conn, &domains,
+                                          VIR_CONNECT_LIST_DOMAINS_ACTIVE);
+    if (nr_domains <= 0) {
+      printf("ERROR: virConnectListAllDomains: nr_domains <= 0\n");
+      teardown();
+      return -1;
+    }
+
+    /* the read state takes over the domain references */
+    for (int i = 0; i < nr_domains; ++i)
+      add_domain(&state, domains[i], true);
+    sfree(domains);
+    nr_domains = 0;
+
+    bulk_stats = true;
+    int ret = lv_read_bulk(&state);
+    /* drivers without bulk stats support make the plugin fall back */
+    if (ret != 0)
+      OK(!bulk_stats);
+
+    free_domains(&state);
+  }
+  teardown();
+
+  return 0;
+}
+#endif
+#endif /* HAVE_BULK_STATS */
+
 int main(void) {
 #ifdef HAVE_LIST_ALL_DOMAINS
   RUN_TEST(get_domain_state_notify);
 #endif
   RUN_TEST(persistent_domains_state_notification);
+#ifdef HAVE_BULK_STATS
+  RUN_TEST(lv_param_index);
+#ifdef HAVE_LIST_ALL_DOMAINS
+  RUN_TEST(lv_read_bulk);
+#endif
+#endif
 
   END_TEST;
 }
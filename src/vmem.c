@@ -28,12 +28,14 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/procfs/procfs.h"
 
 #if KERNEL_LINUX
 static const char *config_keys[] = {"Verbose"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static int verbose_output;
+static cu_procfs_t *vmstat;
 /* #endif KERNEL_LINUX */
 
 #else
@@ -100,38 +102,31 @@ static int vmem_read(void) {
   derive_t pgmajfault = 0;
   int pgfaultvalid = 0;
 
-  FILE *fh;
-  char buffer[1024];
-
-  fh = fopen("/proc/vmstat", "r");
-  if (fh == NULL) {
-    ERROR("vmem plugin: fopen (/proc/vmstat) failed: %s", STRERRNO);
+  if ((vmstat == NULL) &&
+      ((vmstat = cu_procfs_open("/proc/vmstat")) == NULL)) {
+    ERROR("vmem plugin: open (/proc/vmstat) failed: %s", STRERRNO);
     return -1;
   }
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
-    char *fields[4];
-    int fields_num;
-    char *key;
-    char *endptr;
-    derive_t counter;
-    gauge_t gauge;
+  char *cursor = cu_procfs_read(vmstat, NULL);
+  if (cursor == NULL) {
+    ERROR("vmem plugin: reading /proc/vmstat failed: %s", STRERRNO);
+    return -1;
+  }
 
-    fields_num = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
-    if (fields_num != 2)
+  char *key;
+  while ((key = cu_procfs_line(&cursor)) != NULL) {
+    char *value = strchr(key, ' ');
+    if (value == NULL)
       continue;
+    *value = 0;
 
-    key = fields[0];
-
-    endptr = NULL;
-    counter = strtoll(fields[1], &endptr, 10);
-    if (fields[1] == endptr)
+    uint64_t tmp = 0;
+    if (cu_procfs_scan_u64(value + 1, &tmp) == NULL)
       continue;
 
-    endptr = NULL;
-    gauge = strtod(fields[1], &endptr);
-    if (fields[1] == endptr)
-      continue;
+    derive_t counter = (derive_t)tmp;
+    gauge_t gauge = (gauge_t)tmp;
 
     /*
      * Number of pages
@@ -237,10 +232,7 @@ static int vmem_read(void) {
       value_t value = {.derive = counter};
       submit_one(NULL, "vmpage_action", "deactivate", value);
     }
-  } /* while (fgets) */
-
-  fclose(fh);
-  fh = NULL;
+  } /* while (cu_procfs_line) */
 
   if (pgfaultvalid == 0x03)
     submit_two(NULL, "vmpage_faults", NULL, pgfault, pgmajfault);
@@ -255,7 +247,14 @@ static int vmem_read(void) {
   return 0;
 } /* int vmem_read */
 
+static int vmem_shutdown(void) {
+  cu_procfs_close(vmstat);
+  vmstat = NULL;
+  return 0;
+} /* int vmem_shutdown */
+
 void module_register(void) {
   plugin_register_config("vmem", vmem_config, config_keys, config_keys_num);
   plugin_register_read("vmem", vmem_read);
+  plugin_register_shutdown("vmem", vmem_shutdown);
 } /* void module_register */
@@ -0,0 +1,1103 @@
+/**
+ * collectd - src/write_arrow.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; only version 2 of the License is applicable.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ **/
+
+/*
+ * Archives values as Apache Arrow IPC files ("Feather V2"), which can be read
+ * by pyarrow, pandas, polars, DuckDB and friends. Values are buffered in
+ * memory, one column per field, and written as one file per plugin and
+ * buffering period:
+ *
+ *   <DataDir>/date=<YYYY-MM-DD>/plugin=<plugin>/part-<time>-<pid>-<n>.arrow
+ *
+ * Each file has one row per data source and a single record batch. The
+ * identifier columns are dictionary encoded. Of the four value columns, only
+ * the one matching the data source's type is set, the others are null.
+ *
+ * The file format is written directly: the IPC metadata are flatbuffers, which
+ * are simple enough to build without the flatbuffers or Arrow libraries. See
+ * <https://arrow.apache.org/docs/format/Columnar.html> and Schema.fbs,
+ * Message.fbs and File.fbs in the Arrow sources.
+ */
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils/avltree/avltree.h"
+#include "utils/common/common.h"
+
+#define WA_ALIGN(n) (((n) + 7) & ~((size_t)7))
+
+/*
+ * Arrow constants
+ */
+#define ARROW_METADATA_V5 4
+
+#define ARROW_HEADER_SCHEMA 1
+#define ARROW_HEADER_DICTIONARY_BATCH 2
+#define ARROW_HEADER_RECORD_BATCH 3
+
+#define ARROW_TYPE_INT 2
+#define ARROW_TYPE_FLOATING_POINT 3
+#define ARROW_TYPE_UTF8 5
+#define ARROW_TYPE_TIMESTAMP 10
+#define ARROW_TYPE_DURATION 18
+
+#define ARROW_PRECISION_DOUBLE 2
+#define ARROW_TIME_UNIT_NANOSECOND 3
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define ARROW_ENDIANNESS 1 /* Big */
+#else
+#define ARROW_ENDIANNESS 0 /* Little */
+#endif
+
+static char const arrow_magic[] = "ARROW1";
+
+/*
+ * Columns
+ */
+enum {
+  WA_DICT_HOST,
+  WA_DICT_PLUGIN_INSTANCE,
+  WA_DICT_TYPE,
+  WA_DICT_TYPE_INSTANCE,
+  WA_DICT_DS_NAME,
+  WA_DICT_NUM,
+};
+
+enum {
+  WA_COL_TIME,
+  WA_COL_INTERVAL,
+  WA_COL_DICT, /* WA_DICT_NUM dictionary encoded columns */
+  WA_COL_GAUGE = WA_COL_DICT + WA_DICT_NUM,
+  WA_COL_DERIVE,
+  WA_COL_COUNTER,
+  WA_COL_ABSOLUTE,
+  WA_COL_NUM,
+};
+
+typedef struct {
+  char const *name;
+  uint8_t type;
+  int bit_width; /* ARROW_TYPE_INT only */
+  bool is_signed;
+  bool nullable;
+} wa_field_t;
+
+static wa_field_t const wa_fields[WA_COL_NUM] = {
+    [WA_COL_TIME] = {"time", ARROW_TYPE_TIMESTAMP, 0, false, false},
+    [WA_COL_INTERVAL] = {"interval", ARROW_TYPE_DURATION, 0, false, false},
+    [WA_COL_DICT + WA_DICT_HOST] = {"host", ARROW_TYPE_UTF8, 0, false, false},
+    [WA_COL_DICT + WA_DICT_PLUGIN_INSTANCE] = {"plugin_instance",
+                                               ARROW_TYPE_UTF8, 0, false,
+                                               false},
+    [WA_COL_DICT + WA_DICT_TYPE] = {"type", ARROW_TYPE_UTF8, 0, false, false},
+    [WA_COL_DICT + WA_DICT_TYPE_INSTANCE] = {"type_instance", ARROW_TYPE_UTF8,
+                                             0, false, false},
+    [WA_COL_DICT + WA_DICT_DS_NAME] = {"ds_name", ARROW_TYPE_UTF8, 0, false,
+                                       false},
+    [WA_COL_GAUGE] = {"gauge", ARROW_TYPE_FLOATING_POINT, 0, false, true},
+    [WA_COL_DERIVE] = {"derive", ARROW_TYPE_INT, 64, true, true},
+    [WA_COL_COUNTER] = {"counter", ARROW_TYPE_INT, 64, false, true},
+    [WA_COL_ABSOLUTE] = {"absolute", ARROW_TYPE_INT, 64, false, true},
+};
+
+/*
+ * Private data types
+ */
+typedef struct {
+  char **strings;
+  size_t strings_num;
+  size_t strings_size;
+  size_t bytes;
+  c_avl_tree_t *index; /* string -> position + 1 */
+} wa_dict_t;
+
+/* Rows buffered for one plugin. */
+typedef struct {
+  char plugin[DATA_MAX_NAME_LEN];
+  time_t day; /* days since the epoch (UTC) of all rows */
+  cdtime_t first_row;
+
+  size_t rows_num;
+  size_t rows_size;
+  int64_t *time;
+  int64_t *interval;
+  int32_t *dict_index[WA_DICT_NUM];
+  int *ds_type;
+  value_t *value;
+
+  wa_dict_t dict[WA_DICT_NUM];
+} wa_partition_t;
+
+/* A buffer of a message body. */
+typedef struct {
+  void const *data;
+  size_t len;
+} wa_body_t;
+
+typedef struct {
+  int64_t length;
+  int64_t null_count;
+} wa_node_t;
+
+typedef struct {
+  int64_t offset;
+  int32_t meta_len;
+  int64_t body_len;
+} wa_block_t;
+
+/*
+ * Private variables
+ */
+static char *datadir;
+static cdtime_t flush_timeout = TIME_T_TO_CDTIME_T_STATIC(300);
+static size_t batch_rows = 1000000;
+
+static c_avl_tree_t *partitions;
+static pthread_mutex_t partitions_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int file_seq;
+
+/*
+ * Flatbuffer builder
+ *
+ * Like the reference implementation, the buffer is filled from the end
+ * towards the start, so that objects are complete when they are referenced.
+ * Positions are counted from the end of the buffer.
+ */
+#define FB_FIELDS_MAX 8
+
+typedef struct {
+  uint8_t *buf;
+  size_t size;
+  size_t len;
+  size_t minalign;
+  bool failed;
+
+  uint32_t table_start;
+  uint32_t fields[FB_FIELDS_MAX];
+  size_t fields_num;
+} fb_builder_t;
+
+static void fb_reserve(fb_builder_t *b, size_t n) /* {{{ */
+{
+  if (b->failed || (b->len + n <= b->size))
+    return;
+
+  size_t size = (b->size > 0) ? 2 * b->size : 1024;
+  while (size < b->len + n)
+    size *= 2;
+
+  uint8_t *buf = calloc(1, size);
+  if (buf == NULL) {
+    b->failed = true;
+    return;
+  }
+  if (b->len > 0)
+    memcpy(buf + size - b->len, b->buf + b->size - b->len, b->len);
+  free(b->buf);
+  b->buf = buf;
+  b->size = size;
+} /* }}} void fb_reserve */
+
+static void fb_push(fb_builder_t *b, void const *data, size_t n) /* {{{ */
+{
+  fb_reserve(b, n);
+  if (b->failed)
+    return;
+  b->len += n;
+  if (data != NULL)
+    memcpy(b->buf + b->size - b->len, data, n);
+  else
+    memset(b->buf + b->size - b->len, 0, n);
+} /* }}} void fb_push */
+
+static void fb_push_le(fb_builder_t *b, uint64_t v, size_t n) /* {{{ */
+{
+  uint8_t tmp[8];
+  for (size_t i = 0; i < n; i++)
+    tmp[i] = (uint8_t)(v >> (8 * i));
+  fb_push(b, tmp, n);
+} /* }}} void fb_push_le */
+
+/* Pads the buffer so that it is aligned to `align' after `additional' more
+ * bytes have been pushed. */
+static void fb_prep(fb_builder_t *b, size_t align, size_t additional) /* {{{ */
+{
+  if (align > b->minalign)
+    b->minalign = align;
+  size_t pad = (~(b->len + additional) + 1) & (align - 1);
+  if (pad > 0)
+    fb_push(b, NULL, pad);
+} /* }}} void fb_prep */
+
+static uint32_t fb_string(fb_builder_t *b, char const *s) /* {{{ */
+{
+  size_t n = strlen(s);
+  fb_prep(b, 4, n + 1);
+  fb_push(b, NULL, 1);
+  fb_push(b, s, n);
+  fb_push_le(b, n, 4);
+  return (uint32_t)b->len;
+} /* }}} uint32_t fb_string */
+
+static uint32_t fb_vector_offsets(fb_builder_t *b, uint32_t const *offsets,
+                                  size_t num) /* {{{ */
+{
+  fb_prep(b, 4, 4 * num);
+  for (size_t i = num; i > 0; i--)
+    fb_push_le(b, b->len + 4 - offsets[i - 1], 4);
+  fb_push_le(b, num, 4);
+  return (uint32_t)b->len;
+} /* }}} uint32_t fb_vector_offsets */
+
+/* `data' holds `num' little endian structs of `elem_size' bytes each, which
+ * are aligned to 8 bytes. */
+static uint32_t fb_vector_structs(fb_builder_t *b, void const *data,
+                                  size_t elem_size, size_t num) /* {{{ */
+{
+  fb_prep(b, 4, elem_size * num);
+  fb_prep(b, 8, elem_size * num);
+  if (num > 0)
+    fb_push(b, data, elem_size * num);
+  fb_push_le(b, num, 4);
+  return (uint32_t)b->len;
+} /* }}} uint32_t fb_vector_structs */
+
+static void fb_table_start(fb_builder_t *b) /* {{{ */
+{
+  memset(b->fields, 0, sizeof(b->fields));
+  b->fields_num = 0;
+  b->table_start = (uint32_t)b->len;
+} /* }}} void fb_table_start */
+
+static void fb_field_mark(fb_builder_t *b, size_t field) /* {{{ */
+{
+  assert(field < FB_FIELDS_MAX);
+  b->fields[field] = (uint32_t)b->len;
+  if (b->fields_num <= field)
+    b->fields_num = field + 1;
+} /* }}} void fb_field_mark */
+
+static void fb_field_scalar(fb_builder_t *b, size_t field, uint64_t v,
+                            size_t n) /* {{{ */
+{
+  fb_prep(b, n, 0);
+  fb_push_le(b, v, n);
+  fb_field_mark(b, field);
+} /* }}} void fb_field_scalar */
+
+static void fb_field_offset(fb_builder_t *b, size_t field,
+                            uint32_t offset) /* {{{ */
+{
+  fb_prep(b, 4, 0);
+  fb_push_le(b, b->len + 4 - offset, 4);
+  fb_field_mark(b, field);
+} /* }}} void fb_field_offset */
+
+static uint32_t fb_table_end(fb_builder_t *b) /* {{{ */
+{
+  fb_prep(b, 4, 0);
+  fb_push_le(b, 0, 4); /* offset of the vtable, set below */
+  uint32_t table = (uint32_t)b->len;
+
+  for (size_t i = b->fields_num; i > 0; i--) {
+    uint32_t field = b->fields[i - 1];
+    fb_push_le(b, (field != 0) ? table - field : 0, 2);
+  }
+  fb_push_le(b, table - b->table_start, 2);
+  fb_push_le(b, 2 * (b->fields_num + 2), 2);
+
+  if (!b->failed) {
+    int32_t vtable = (int32_t)(b->len - table);
+    uint8_t *p = b->buf + b->size - table;
+    for (size_t i = 0; i < 4; i++)
+      p[i] = (uint8_t)((uint32_t)vtable >> (8 * i));
+  }
+  return table;
+} /* }}} uint32_t fb_table_end */
+
+/* Adds the root offset. The finished buffer is `b->len' bytes long, a multiple
+ * of eight, and starts at fb_data(). */
+static void fb_finish(fb_builder_t *b, uint32_t root) /* {{{ */
+{
+  fb_prep(b, (b->minalign > 8) ? b->minalign : 8, 4);
+  fb_push_le(b, b->len + 4 - root, 4);
+} /* }}} void fb_finish */
+
+static uint8_t const *fb_data(fb_builder_t const *b) {
+  return b->buf + b->size - b->len;
+}
+
+static void fb_reset(fb_builder_t *b) {
+  b->len = 0;
+  b->minalign = 1;
+  b->failed = false;
+}
+
+static void fb_free(fb_builder_t *b) {
+  free(b->buf);
+  memset(b, 0, sizeof(*b));
+}
+
+static void le64(uint8_t *p, uint64_t v) {
+  for (size_t i = 0; i < 8; i++)
+    p[i] = (uint8_t)(v >> (8 * i));
+}
+
+/*
+ * Arrow metadata
+ */
+static uint32_t wa_fb_int(fb_builder_t *b, int bit_width,
+                          bool is_signed) /* {{{ */
+{
+  fb_table_start(b);
+  fb_field_scalar(b, 0, (uint32_t)bit_width, 4);
+  fb_field_scalar(b, 1, is_signed, 1);
+  return fb_table_end(b);
+} /* }}} uint32_t wa_fb_int */
+
+static uint32_t wa_fb_field_type(fb_builder_t *b,
+                                 wa_field_t const *f) /* {{{ */
+{
+  switch (f->type) {
+  case ARROW_TYPE_INT:
+    return wa_fb_int(b, f->bit_width, f->is_signed);
+  case ARROW_TYPE_FLOATING_POINT:
+    fb_table_start(b);
+    fb_field_scalar(b, 0, ARROW_PRECISION_DOUBLE, 2);
+    return fb_table_end(b);
+  case ARROW_TYPE_TIMESTAMP: {
+    uint32_t tz = fb_string(b, "UTC");
+    fb_table_start(b);
+    fb_field_offset(b, 1, tz);
+    fb_field_scalar(b, 0, ARROW_TIME_UNIT_NANOSECOND, 2);
+    return fb_table_end(b);
+  }
+  case ARROW_TYPE_DURATION:
+    fb_table_start(b);
+    fb_field_scalar(b, 0, ARROW_TIME_UNIT_NANOSECOND, 2);
+    return fb_table_end(b);
+  default: /* ARROW_TYPE_UTF8 */
+    fb_table_start(b);
+    return fb_table_end(b);
+  }
+} /* }}} uint32_t wa_fb_field_type */
+
+static uint32_t wa_fb_schema(fb_builder_t *b) /* {{{ */
+{
+  uint32_t fields[WA_COL_NUM];
+
+  for (size_t i = 0; i < WA_COL_NUM; i++) {
+    wa_field_t const *f = wa_fields + i;
+
+    uint32_t name = fb_string(b, f->name);
+    uint32_t type = wa_fb_field_type(b, f);
+    uint32_t children = fb_vector_offsets(b, NULL, 0);
+
+    uint32_t dictionary = 0;
+    if ((i >= WA_COL_DICT) && (i < WA_COL_DICT + WA_DICT_NUM)) {
+      uint32_t index_type = wa_fb_int(b, 32, true);
+      fb_table_start(b);
+      fb_field_scalar(b, 0, i - WA_COL_DICT, 8); /* id */
+      fb_field_offset(b, 1, index_type);
+      dictionary = fb_table_end(b);
+    }
+
+    fb_table_start(b);
+    fb_field_offset(b, 0, name);
+    fb_field_offset(b, 3, type);
+    if (dictionary != 0)
+      fb_field_offset(b, 4, dictionary);
+    fb_field_offset(b, 5, children);
+    fb_field_scalar(b, 1, f->nullable, 1);
+    fb_field_scalar(b, 2, f->type, 1);
+    fields[i] = fb_table_end(b);
+  }
+
+  uint32_t fields_vec = fb_vector_offsets(b, fields, WA_COL_NUM);
+  fb_table_start(b);
+  fb_field_offset(b, 1, fields_vec);
+  fb_field_scalar(b, 0, ARROW_ENDIANNESS, 2);
+  return fb_table_end(b);
+} /* }}} uint32_t wa_fb_schema */
+
+/* Builds a RecordBatch table for a body whose buffers are described by
+ * `body'. */
+static uint32_t wa_fb_record_batch(fb_builder_t *b, size_t rows,
+                                   wa_node_t const *nodes, size_t nodes_num,
+                                   wa_body_t const *body,
+                                   size_t body_num) /* {{{ */
+{
+  uint8_t tmp[16 * (WA_COL_NUM * 2 + 3)];
+  assert(nodes_num <= WA_COL_NUM && body_num <= STATIC_ARRAY_SIZE(tmp) / 16);
+
+  for (size_t i = 0; i < nodes_num; i++) {
+    le64(tmp + 16 * i, (uint64_t)nodes[i].length);
+    le64(tmp + 16 * i + 8, (uint64_t)nodes[i].null_count);
+  }
+  uint32_t nodes_vec = fb_vector_structs(b, tmp, 16, nodes_num);
+
+  size_t offset = 0;
+  for (size_t i = 0; i < body_num; i++) {
+    le64(tmp + 16 * i, offset);
+    le64(tmp + 16 * i + 8, body[i].len);
+    offset += WA_ALIGN(body[i].len);
+  }
+  uint32_t buffers_vec = fb_vector_structs(b, tmp, 16, body_num);
+
+  fb_table_start(b);
+  fb_field_scalar(b, 0, rows, 8);
+  fb_field_offset(b, 1, nodes_vec);
+  fb_field_offset(b, 2, buffers_vec);
+  return fb_table_end(b);
+} /* }}} uint32_t wa_fb_record_batch */
+
+static void wa_fb_message(fb_builder_t *b, uint8_t header_type,
+                          uint32_t header, size_t body_len) /* {{{ */
+{
+  fb_table_start(b);
+  fb_field_scalar(b, 3, body_len, 8);
+  fb_field_offset(b, 2, header);
+  fb_field_scalar(b, 0, ARROW_METADATA_V5, 2);
+  fb_field_scalar(b, 1, header_type, 1);
+  fb_finish(b, fb_table_end(b));
+} /* }}} void wa_fb_message */
+
+static uint32_t wa_fb_blocks(fb_builder_t *b, wa_block_t const *blocks,
+                             size_t num) /* {{{ */
+{
+  uint8_t tmp[24 * (WA_DICT_NUM + 1)];
+  assert(num <= WA_DICT_NUM + 1);
+
+  memset(tmp, 0, sizeof(tmp));
+  for (size_t i = 0; i < num; i++) {
+    le64(tmp + 24 * i, (uint64_t)blocks[i].offset);
+    le64(tmp + 24 * i + 8, (uint32_t)blocks[i].meta_len);
+    le64(tmp + 24 * i + 16, (uint64_t)blocks[i].body_len);
+  }
+  return fb_vector_structs(b, tmp, 24, num);
+} /* }}} uint32_t wa_fb_blocks */
+
+/*
+ * File output
+ */
+typedef struct {
+  FILE *fh;
+  uint64_t offset;
+  bool failed;
+} wa_file_t;
+
+static void wa_file_write(wa_file_t *f, void const *data, size_t len) {
+  static uint8_t const zero[8];
+
+  if (f->failed || (len == 0))
+    return;
+  if (fwrite((data != NULL) ? data : zero, 1, len, f->fh) != len)
+    f->failed = true;
+  f->offset += len;
+}
+
+static void wa_file_pad(wa_file_t *f) {
+  wa_file_write(f, NULL, WA_ALIGN(f->offset) - f->offset);
+}
+
+/* Writes an encapsulated message: the metadata in `b', built by
+ * wa_fb_message(), followed by the body. */
+static void wa_write_message(wa_file_t *f, fb_builder_t const *b,
+                             wa_body_t const *body, size_t body_num,
+                             wa_block_t *ret_block) /* {{{ */
+{
+  uint8_t prefix[8];
+  memset(prefix, 0xff, 4); /* continuation marker */
+  for (size_t i = 0; i < 4; i++)
+    prefix[4 + i] = (uint8_t)(b->len >> (8 * i));
+
+  ret_block->offset = (int64_t)f->offset;
+  ret_block->meta_len = (int32_t)(sizeof(prefix) + b->len);
+  wa_file_write(f, prefix, sizeof(prefix));
+  wa_file_write(f, fb_data(b), b->len);
+
+  uint64_t body_start = f->offset;
+  for (size_t i = 0; i < body_num; i++) {
+    /* Arrow requires buffers in the host's byte order: the schema declares
+     * which one that is. */
+    wa_file_write(f, body[i].data, body[i].len);
+    wa_file_pad(f);
+  }
+  ret_block->body_len = (int64_t)(f->offset - body_start);
+} /* }}} void wa_write_message */
+
+static size_t wa_body_len(wa_body_t const *body, size_t body_num) {
+  size_t len = 0;
+  for (size_t i = 0; i < body_num; i++)
+    len += WA_ALIGN(body[i].len);
+  return len;
+}
+
+/* Writes the dictionary `id' as a DictionaryBatch message. */
+static int wa_write_dictionary(wa_file_t *f, fb_builder_t *b,
+                               wa_dict_t const *d, int id,
+                               wa_block_t *ret_block) /* {{{ */
+{
+  int32_t *offsets = calloc(d->strings_num + 1, sizeof(*offsets));
+  char *data = malloc(d->bytes + 1);
+  if ((offsets == NULL) || (data == NULL)) {
+    free(offsets);
+    free(data);
+    return ENOMEM;
+  }
+
+  size_t pos = 0;
+  for (size_t i = 0; i < d->strings_num; i++) {
+    size_t len = strlen(d->strings[i]);
+    memcpy(data + pos, d->strings[i], len);
+    pos += len;
+    offsets[i + 1] = (int32_t)pos;
+  }
+
+  wa_node_t node = {.length = (int64_t)d->strings_num};
+  wa_body_t body[] = {
+      {NULL, 0}, /* validity */
+      {offsets, sizeof(*offsets) * (d->strings_num + 1)},
+      {data, pos},
+  };
+
+  fb_reset(b);
+  uint32_t batch = wa_fb_record_batch(b, d->strings_num, &node, 1, body,
+                                      STATIC_ARRAY_SIZE(body));
+  fb_table_start(b);
+  fb_field_scalar(b, 0, (uint64_t)id, 8);
+  fb_field_offset(b, 1, batch);
+  uint32_t dict_batch = fb_table_end(b);
+  wa_fb_message(b, ARROW_HEADER_DICTIONARY_BATCH, dict_batch,
+                wa_body_len(body, STATIC_ARRAY_SIZE(body)));
+
+  if (!b->failed)
+    wa_write_message(f, b, body, STATIC_ARRAY_SIZE(body), ret_block);
+
+  free(offsets);
+  free(data);
+  return b->failed ? ENOMEM : 0;
+} /* }}} int wa_write_dictionary */
+
+static int wa_write_record_batch(wa_file_t *f, fb_builder_t *b,
+                                 wa_partition_t const *p,
+                                 wa_block_t *ret_block) /* {{{ */
+{
+  static int const ds_types[] = {
+      [WA_COL_GAUGE - WA_COL_GAUGE] = DS_TYPE_GAUGE,
+      [WA_COL_DERIVE - WA_COL_GAUGE] = DS_TYPE_DERIVE,
+      [WA_COL_COUNTER - WA_COL_GAUGE] = DS_TYPE_COUNTER,
+      [WA_COL_ABSOLUTE - WA_COL_GAUGE] = DS_TYPE_ABSOLUTE,
+  };
+  size_t const values_num = STATIC_ARRAY_SIZE(ds_types);
+  size_t const bitmap_len = (p->rows_num + 7) / 8;
+
+  uint8_t *columns = calloc(values_num, 8 * p->rows_num);
+  uint8_t *bitmaps = calloc(values_num, bitmap_len);
+  if ((columns == NULL) || (bitmaps == NULL)) {
+    free(columns);
+    free(bitmaps);
+    return ENOMEM;
+  }
+
+  wa_node_t nodes[WA_COL_NUM];
+  wa_body_t body[2 * WA_COL_NUM];
+  size_t body_num = 0;
+
+  nodes[WA_COL_TIME] = (wa_node_t){.length = (int64_t)p->rows_num};
+  body[body_num++] = (wa_body_t){NULL, 0};
+  body[body_num++] = (wa_body_t){p->time, 8 * p->rows_num};
+
+  nodes[WA_COL_INTERVAL] = (wa_node_t){.length = (int64_t)p->rows_num};
+  body[body_num++] = (wa_body_t){NULL, 0};
+  body[body_num++] = (wa_body_t){p->interval, 8 * p->rows_num};
+
+  for (size_t i = 0; i < WA_DICT_NUM; i++) {
+    nodes[WA_COL_DICT + i] = (wa_node_t){.length = (int64_t)p->rows_num};
+    body[body_num++] = (wa_body_t){NULL, 0};
+    body[body_num++] = (wa_body_t){p->dict_index[i], 4 * p->rows_num};
+  }
+
+  for (size_t i = 0; i < values_num; i++) {
+    uint8_t *column = columns + 8 * p->rows_num * i;
+    uint8_t *bitmap = bitmaps + bitmap_len * i;
+    size_t null_count = 0;
+
+    for (size_t j = 0; j < p->rows_num; j++) {
+      if (p->ds_type[j] != ds_types[i]) {
+        null_count++;
+        continue;
+      }
+      bitmap[j / 8] |= (uint8_t)(1 << (j % 8));
+      /* gauge_t, derive_t, counter_t and absolute_t all have eight bytes. */
+      memcpy(column + 8 * j, p->value + j, 8);
+    }
+
+    nodes[WA_COL_GAUGE + i] = (wa_node_t){
+        .length = (int64_t)p->rows_num,
+        .null_count = (int64_t)null_count,
+    };
+    body[body_num++] =
+        (wa_body_t){bitmap, (null_count > 0) ? bitmap_len : 0};
+    body[body_num++] = (wa_body_t){column, 8 * p->rows_num};
+  }
+
+  fb_reset(b);
+  uint32_t batch =
+      wa_fb_record_batch(b, p->rows_num, nodes, WA_COL_NUM, body, body_num);
+  wa_fb_message(b, ARROW_HEADER_RECORD_BATCH, batch,
+                wa_body_len(body, body_num));
+
+  if (!b->failed)
+    wa_write_message(f, b, body, body_num, ret_block);
+
+  free(columns);
+  free(bitmaps);
+  return b->failed ? ENOMEM : 0;
+} /* }}} int wa_write_record_batch */
+
+static int wa_write_file(FILE *fh, wa_partition_t const *p) /* {{{ */
+{
+  wa_file_t f = {.fh = fh};
+  fb_builder_t b = {0};
+  wa_block_t dictionaries[WA_DICT_NUM];
+  wa_block_t record_batch;
+  wa_block_t schema;
+  int status = 0;
+
+  wa_file_write(&f, arrow_magic, sizeof(arrow_magic));
+  wa_file_pad(&f);
+
+  fb_reset(&b);
+  wa_fb_message(&b, ARROW_HEADER_SCHEMA, wa_fb_schema(&b), 0);
+  if (b.failed)
+    status = ENOMEM;
+  else
+    wa_write_message(&f, &b, NULL, 0, &schema);
+
+  for (size_t i = 0; (status == 0) && (i < WA_DICT_NUM); i++)
+    status = wa_write_dictionary(&f, &b, p->dict + i, (int)i,
+                                 dictionaries + i);
+  if (status == 0)
+    status = wa_write_record_batch(&f, &b, p, &record_batch);
+
+  if (status == 0) {
+    /* end-of-stream marker */
+    uint8_t eos[8] = {0xff, 0xff, 0xff, 0xff, 0, 0, 0, 0};
+    wa_file_write(&f, eos, sizeof(eos));
+
+    fb_reset(&b);
+    uint32_t footer_schema = wa_fb_schema(&b);
+    uint32_t dicts_vec = wa_fb_blocks(&b, dictionaries, WA_DICT_NUM);
+    uint32_t batches_vec = wa_fb_blocks(&b, &record_batch, 1);
+    fb_table_start(&b);
+    fb_field_offset(&b, 1, footer_schema);
+    fb_field_offset(&b, 2, dicts_vec);
+    fb_field_offset(&b, 3, batches_vec);
+    fb_field_scalar(&b, 0, ARROW_METADATA_V5, 2);
+    fb_finish(&b, fb_table_end(&b));
+
+    if (b.failed) {
+      status = ENOMEM;
+    } else {
+      uint8_t footer_len[4];
+      for (size_t i = 0; i < 4; i++)
+        footer_len[i] = (uint8_t)(b.len >> (8 * i));
+      wa_file_write(&f, fb_data(&b), b.len);
+      wa_file_write(&f, footer_len, sizeof(footer_len));
+      wa_file_write(&f, arrow_magic, strlen(arrow_magic));
+    }
+  }
+
+  fb_free(&b);
+  if ((status == 0) && f.failed)
+    status = errno ? errno : EIO;
+  return status;
+} /* }}} int wa_write_file */
+
+/*
+ * Partitions
+ */
+static int wa_dict_add(wa_dict_t *d, char const *s, int32_t *ret) /* {{{ */
+{
+  void *value = NULL;
+  if ((d->index != NULL) && (c_avl_get(d->index, s, &value) == 0)) {
+    *ret = (int32_t)((uintptr_t)value - 1);
+    return 0;
+  }
+
+  if (d->index == NULL) {
+    d->index = c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (d->index == NULL)
+      return ENOMEM;
+  }
+
+  if (d->strings_num == d->strings_size) {
+    size_t size = (d->strings_size > 0) ? 2 * d->strings_size : 16;
+    char **tmp = realloc(d->strings, size * sizeof(*d->strings));
+    if (tmp == NULL)
+      return ENOMEM;
+    d->strings = tmp;
+    d->strings_size = size;
+  }
+
+  char *copy = strdup(s);
+  if (copy == NULL)
+    return ENOMEM;
+  if (c_avl_insert(d->index, copy,
+                   (void *)(uintptr_t)(d->strings_num + 1)) != 0) {
+    free(copy);
+    return ENOMEM;
+  }
+
+  d->strings[d->strings_num] = copy;
+  *ret = (int32_t)d->strings_num;
+  d->strings_num++;
+  d->bytes += strlen(copy);
+  return 0;
+} /* }}} int wa_dict_add */
+
+static void wa_dict_clear(wa_dict_t *d) /* {{{ */
+{
+  c_avl_destroy(d->index);
+  for (size_t i = 0; i < d->strings_num; i++)
+    free(d->strings[i]);
+  free(d->strings);
+  memset(d, 0, sizeof(*d));
+} /* }}} void wa_dict_clear */
+
+static void wa_partition_clear(wa_partition_t *p) /* {{{ */
+{
+  for (size_t i = 0; i < WA_DICT_NUM; i++) {
+    wa_dict_clear(p->dict + i);
+    sfree(p->dict_index[i]);
+  }
+  sfree(p->time);
+  sfree(p->interval);
+  sfree(p->ds_type);
+  sfree(p->value);
+  p->rows_num = 0;
+  p->rows_size = 0;
+} /* }}} void wa_partition_clear */
+
+static int wa_partition_grow(wa_partition_t *p) /* {{{ */
+{
+  size_t size = (p->rows_size > 0) ? 2 * p->rows_size : 256;
+
+#define WA_GROW(ptr)                                                           \
+  do {                                                                         \
+    void *tmp = realloc((ptr), size * sizeof(*(ptr)));                         \
+    if (tmp == NULL)                                                           \
+      return ENOMEM;                                                           \
+    (ptr) = tmp;                                                               \
+  } while (0)
+
+  WA_GROW(p->time);
+  WA_GROW(p->interval);
+  WA_GROW(p->ds_type);
+  WA_GROW(p->value);
+  for (size_t i = 0; i < WA_DICT_NUM; i++)
+    WA_GROW(p->dict_index[i]);
+#undef WA_GROW
+
+  p->rows_size = size;
+  return 0;
+} /* }}} int wa_partition_grow */
+
+static int wa_partition_flush(wa_partition_t *p) /* {{{ */
+{
+  if (p->rows_num == 0)
+    return 0;
+
+  char date[16];
+  struct tm tm;
+  time_t t = p->day * 86400;
+  if ((gmtime_r(&t, &tm) == NULL) ||
+      (strftime(date, sizeof(date), "%Y-%m-%d", &tm) == 0)) {
+    ERROR("write_arrow plugin: Formatting the date failed.");
+    wa_partition_clear(p);
+    return -1;
+  }
+
+  char dir[PATH_MAX];
+  char file[PATH_MAX];
+  char tmp_file[PATH_MAX];
+  unsigned int seq = ++file_seq;
+  uint64_t now = (uint64_t)CDTIME_T_TO_TIME_T(cdtime());
+
+  int len = snprintf(dir, sizeof(dir) - 64, "%s%sdate=%s/plugin=%s/",
+                     (datadir != NULL) ? datadir : "",
+                     (datadir != NULL) ? "/" : "", date, p->plugin);
+  if ((len < 0) || ((size_t)len >= sizeof(dir) - 64)) {
+    ERROR("write_arrow plugin: The path of plugin \"%s\" is too long.",
+          p->plugin);
+    wa_partition_clear(p);
+    return -1;
+  }
+  /* The directory leaves 64 bytes for the file name. */
+  snprintf(file, sizeof(file), "%.*spart-%" PRIu64 "-%d-%u.arrow", len, dir,
+           now, (int)getpid(), seq);
+  snprintf(tmp_file, sizeof(tmp_file), "%.*s.part-%" PRIu64 "-%d-%u.tmp",
+           len, dir, now, (int)getpid(), seq);
+
+  if (check_create_dir(dir) != 0) {
+    ERROR("write_arrow plugin: Creating \"%s\" failed.", dir);
+    wa_partition_clear(p);
+    return -1;
+  }
+
+  FILE *fh = fopen(tmp_file, "w");
+  if (fh == NULL) {
+    ERROR("write_arrow plugin: fopen (%s) failed: %s", tmp_file, STRERRNO);
+    wa_partition_clear(p);
+    return -1;
+  }
+
+  int status = wa_write_file(fh, p);
+  if ((fclose(fh) != 0) && (status == 0))
+    status = errno;
+  if ((status == 0) && (rename(tmp_file, file) != 0))
+    status = errno;
+
+  if (status != 0) {
+    ERROR("write_arrow plugin: Writing \"%s\" failed: %s", file,
+          STRERROR(status));
+    unlink(tmp_file);
+  } else {
+    DEBUG("write_arrow plugin: Wrote %" PRIsz " rows to \"%s\".", p->rows_num,
+          file);
+  }
+
+  wa_partition_clear(p);
+  return status;
+} /* }}} int wa_partition_flush */
+
+static wa_partition_t *wa_partition_get(char const *plugin) /* {{{ */
+{
+  wa_partition_t *p = NULL;
+
+  if (partitions == NULL) {
+    partitions = c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (partitions == NULL)
+      return NULL;
+  }
+
+  if (c_avl_get(partitions, plugin, (void *)&p) == 0)
+    return p;
+
+  p = calloc(1, sizeof(*p));
+  if (p == NULL)
+    return NULL;
+  sstrncpy(p->plugin, plugin, sizeof(p->plugin));
+
+  if (c_avl_insert(partitions, p->plugin, p) != 0) {
+    free(p);
+    return NULL;
+  }
+  return p;
+} /* }}} wa_partition_t *wa_partition_get */
+
+static int wa_partition_add(wa_partition_t *p, data_set_t const *ds,
+                            value_list_t const *vl) /* {{{ */
+{
+  time_t day = CDTIME_T_TO_TIME_T(vl->time) / 86400;
+
+  /* Rows of different days go to different directories. */
+  if ((p->rows_num > 0) && (p->day != day))
+    wa_partition_flush(p);
+
+  if (p->rows_num == 0) {
+    p->day = day;
+    p->first_row = cdtime();
+  }
+
+  int32_t ids[WA_DICT_NUM];
+  char const *names[WA_DICT_NUM] = {
+      [WA_DICT_HOST] = vl->host,
+      [WA_DICT_PLUGIN_INSTANCE] = vl->plugin_instance,
+      [WA_DICT_TYPE] = vl->type,
+      [WA_DICT_TYPE_INSTANCE] = vl->type_instance,
+  };
+  for (size_t i = 0; i < WA_DICT_DS_NAME; i++) {
+    int status = wa_dict_add(p->dict + i, names[i], ids + i);
+    if (status != 0)
+      return status;
+  }
+
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    if (p->rows_num == p->rows_size) {
+      int status = wa_partition_grow(p);
+      if (status != 0)
+        return status;
+    }
+
+    int status = wa_dict_add(p->dict + WA_DICT_DS_NAME, ds->ds[i].name,
+                             ids + WA_DICT_DS_NAME);
+    if (status != 0)
+      return status;
+
+    size_t row = p->rows_num;
+    p->time[row] = (int64_t)CDTIME_T_TO_NS(vl->time);
+    p->interval[row] = (int64_t)CDTIME_T_TO_NS(vl->interval);
+    for (size_t j = 0; j < WA_DICT_NUM; j++)
+      p->dict_index[j][row] = ids[j];
+    p->ds_type[row] = ds->ds[i].type;
+    p->value[row] = vl->values[i];
+    p->rows_num++;
+  }
+
+  return 0;
+} /* }}} int wa_partition_add */
+
+/* Writes all partitions that have been buffering for at least `timeout', or
+ * all of them if `timeout' is zero. Must be called with partitions_lock
+ * held. */
+static void wa_flush_partitions(cdtime_t timeout) /* {{{ */
+{
+  if (partitions == NULL)
+    return;
+
+  cdtime_t now = cdtime();
+  c_avl_iterator_t *iter = c_avl_get_iterator(partitions);
+  char *plugin;
+  wa_partition_t *p;
+
+  while (c_avl_iterator_next(iter, (void *)&plugin, (void *)&p) == 0) {
+    if ((p->rows_num > 0) &&
+        ((timeout == 0) || ((now - p->first_row) >= timeout)))
+      wa_partition_flush(p);
+  }
+  c_avl_iterator_destroy(iter);
+} /* }}} void wa_flush_partitions */
+
+static int wa_write_batch(write_batch_entry_t const *entries,
+                          size_t entries_num,
+                          user_data_t __attribute__((unused)) *
+                              user_data) /* {{{ */
+{
+  int status = 0;
+
+  pthread_mutex_lock(&partitions_lock);
+  for (size_t i = 0; i < entries_num; i++) {
+    value_list_t const *vl = entries[i].vl;
+
+    wa_partition_t *p = wa_partition_get(vl->plugin);
+    if (p == NULL) {
+      status = ENOMEM;
+      continue;
+    }
+
+    int tmp = wa_partition_add(p, entries[i].ds, vl);
+    if (tmp != 0) {
+      status = tmp;
+      continue;
+    }
+
+    if (p->rows_num >= batch_rows)
+      wa_partition_flush(p);
+  }
+
+  wa_flush_partitions(flush_timeout);
+  pthread_mutex_unlock(&partitions_lock);
+
+  if (status != 0)
+    ERROR("write_arrow plugin: Buffering values failed: %s",
+          STRERROR(status));
+  return status;
+} /* }}} int wa_write_batch */
+
+static int wa_flush(cdtime_t timeout,
+                    char const __attribute__((unused)) * identifier,
+                    user_data_t __attribute__((unused)) * user_data) /* {{{ */
+{
+  pthread_mutex_lock(&partitions_lock);
+  wa_flush_partitions(timeout);
+  pthread_mutex_unlock(&partitions_lock);
+  return 0;
+} /* }}} int wa_flush */
+
+static int wa_shutdown(void) /* {{{ */
+{
+  pthread_mutex_lock(&partitions_lock);
+  wa_flush_partitions(0);
+
+  if (partitions != NULL) {
+    char *plugin;
+    wa_partition_t *p;
+    while (c_avl_pick(partitions, (void *)&plugin, (void *)&p) == 0) {
+      wa_partition_clear(p);
+      free(p);
+    }
+    c_avl_destroy(partitions);
+    partitions = NULL;
+  }
+  pthread_mutex_unlock(&partitions_lock);
+
+  sfree(datadir);
+  return 0;
+} /* }}} int wa_shutdown */
+
+static int wa_config(oconfig_item_t *ci) /* {{{ */
+{
+  for (int i = 0; i < ci->children_num; i++) {
+    oconfig_item_t *child = ci->children + i;
+    int status = 0;
+
+    if (strcasecmp("DataDir", child->key) == 0) {
+      status = cf_util_get_string(child, &datadir);
+      if ((status == 0) && (datadir != NULL)) {
+        size_t len = strlen(datadir);
+        while ((len > 0) && (datadir[len - 1] == '/'))
+          datadir[--len] = '\0';
+        if (len == 0)
+          sfree(datadir);
+      }
+    } else if (strcasecmp("FlushTimeout", child->key) == 0) {
+      status = cf_util_get_cdtime(child, &flush_timeout);
+    } else if (strcasecmp("BatchRows", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp < 1)) {
+        ERROR("write_arrow plugin: BatchRows must be positive.");
+        status = -1;
+      } else if (status == 0) {
+        batch_rows = (size_t)tmp;
+      }
+    } else {
+      ERROR("write_arrow plugin: Invalid configuration option: %s.",
+            child->key);
+      status = -1;
+    }
+
+    if (status != 0)
+      return status;
+  }
+
+  return 0;
+} /* }}} int wa_config */
+
+void module_register(void) {
+  plugin_register_complex_config("write_arrow", wa_config);
+  plugin_register_write_batch("write_arrow", wa_write_batch,
+                              /* batch_size = */ 0, /* max_age = */ 0,
+                              /* user_data = */ NULL);
+  plugin_register_flush("write_arrow", wa_flush, /* user_data = */ NULL);
+  plugin_register_shutdown("write_arrow", wa_shutdown);
+} /* void module_register */
@@ -50,9 +50,7 @@
 #include "utils/common/common.h"
 
 #include "utils/format_graphite/format_graphite.h"
-#include "utils_complain.h"
-
-#include <netdb.h>
+#include "utils/tcp_pool/tcp_pool.h"
 
 #ifndef WG_DEFAULT_NODE
 #define WG_DEFAULT_NODE "localhost"
@@ -79,16 +77,22 @@
 #define WG_SEND_BUF_SIZE 1428
 #endif
 
-#ifndef WG_MIN_RECONNECT_INTERVAL
-#define WG_MIN_RECONNECT_INTERVAL TIME_T_TO_CDTIME_T(1)
+#ifndef WG_DEFAULT_BACKLOG_SIZE
+#define WG_DEFAULT_BACKLOG_SIZE (1024 * 1024)
 #endif
 
+#define WG_DISTRIBUTION_ROUND_ROBIN 0
+#define WG_DISTRIBUTION_CONSISTENT_HASH 1
+
 /*
  * Private variables
  */
-struct wg_callback {
-  int sock_fd;
+typedef struct {
+  char *node;
+  char *service;
+} wg_server_t;
 
+struct wg_callback {
   char *name;
 
   char *node;
@@ -100,185 +104,63 @@ struct wg_callback {
   char escape_char;
 
   unsigned int format_flags;
+  int name_cache_size;
+  graphite_cache_t *name_cache;
 
-  char send_buf[WG_SEND_BUF_SIZE];
-  size_t send_buf_free;
-  size_t send_buf_fill;
-  cdtime_t send_buf_init_time;
-
-  pthread_mutex_t send_lock;
-  c_complain_t init_complaint;
-  cdtime_t last_connect_time;
+  wg_server_t *servers;
+  size_t servers_num;
+  int connections;
+  int distribution;
+  size_t backlog_size;
 
   /* Force reconnect useful for load balanced environments */
-  cdtime_t last_reconnect_time;
   cdtime_t reconnect_interval;
-  bool reconnect_interval_reached;
-};
-
-/* wg_force_reconnect_check closes cb->sock_fd when it was open for longer
- * than cb->reconnect_interval. Must hold cb->send_lock when calling. */
-static void wg_force_reconnect_check(struct wg_callback *cb) {
-  cdtime_t now;
-
-  if (cb->reconnect_interval == 0)
-    return;
-
-  /* check if address changes if addr_timeout */
-  now = cdtime();
-  if ((now - cb->last_reconnect_time) < cb->reconnect_interval)
-    return;
 
-  /* here we should close connection on next */
-  close(cb->sock_fd);
-  cb->sock_fd = -1;
-  cb->last_reconnect_time = now;
-  cb->reconnect_interval_reached = true;
-
-  INFO("write_graphite plugin: Connection closed after %.3f seconds.",
-       CDTIME_T_TO_DOUBLE(now - cb->last_reconnect_time));
-}
+  /* Protects the name cache and the creation of the pool. */
+  pthread_mutex_t lock;
+  c_tcp_pool_t *pool;
+};
 
 /*
  * Functions
  */
-static void wg_reset_buffer(struct wg_callback *cb) {
-  memset(cb->send_buf, 0, sizeof(cb->send_buf));
-  cb->send_buf_free = sizeof(cb->send_buf);
-  cb->send_buf_fill = 0;
-  cb->send_buf_init_time = cdtime();
-}
-
-static int wg_send_buffer(struct wg_callback *cb) {
-  ssize_t status;
-
-  if (cb->sock_fd < 0)
-    return -1;
-
-  status = swrite(cb->sock_fd, cb->send_buf, strlen(cb->send_buf));
-  if (status != 0) {
-    if (cb->log_send_errors) {
-      ERROR("write_graphite plugin: send to %s:%s (%s) failed with status %zi "
-            "(%s)",
-            cb->node, cb->service, cb->protocol, status, STRERRNO);
-    }
-
-    close(cb->sock_fd);
-    cb->sock_fd = -1;
-
-    return -1;
-  }
-
-  return 0;
-}
-
-/* NOTE: You must hold cb->send_lock when calling this function! */
-static int wg_flush_nolock(cdtime_t timeout, struct wg_callback *cb) {
-  int status;
-
-  DEBUG("write_graphite plugin: wg_flush_nolock: timeout = %.3f; "
-        "send_buf_fill = %" PRIsz ";",
-        (double)timeout, cb->send_buf_fill);
-
-  /* timeout == 0  => flush unconditionally */
-  if (timeout > 0) {
-    cdtime_t now;
-
-    now = cdtime();
-    if ((cb->send_buf_init_time + timeout) > now)
-      return 0;
-  }
-
-  if (cb->send_buf_fill == 0) {
-    cb->send_buf_init_time = cdtime();
-    return 0;
-  }
-
-  status = wg_send_buffer(cb);
-  wg_reset_buffer(cb);
-
-  return status;
-}
-
-static int wg_callback_init(struct wg_callback *cb) {
-  struct addrinfo *ai_list;
-  cdtime_t now;
-  int status;
-
-  char connerr[1024] = "";
-
-  if (cb->sock_fd > 0)
-    return 0;
-
-  /* Don't try to reconnect too often. By default, one reconnection attempt
-   * is made per second. */
-  now = cdtime();
-  if ((now - cb->last_connect_time) < WG_MIN_RECONNECT_INTERVAL)
-    return EAGAIN;
-  cb->last_connect_time = now;
-
-  struct addrinfo ai_hints = {.ai_family = AF_UNSPEC,
-                              .ai_flags = AI_ADDRCONFIG};
-
-  if (0 == strcasecmp("tcp", cb->protocol))
-    ai_hints.ai_socktype = SOCK_STREAM;
-  else
-    ai_hints.ai_socktype = SOCK_DGRAM;
-
-  status = getaddrinfo(cb->node, cb->service, &ai_hints, &ai_list);
-  if (status != 0) {
-    ERROR("write_graphite plugin: getaddrinfo (%s, %s, %s) failed: %s",
-          cb->node, cb->service, cb->protocol, gai_strerror(status));
-    return -1;
-  }
-
-  assert(ai_list != NULL);
-  for (struct addrinfo *ai_ptr = ai_list; ai_ptr != NULL;
-       ai_ptr = ai_ptr->ai_next) {
-    cb->sock_fd =
-        socket(ai_ptr->ai_family, ai_ptr->ai_socktype, ai_ptr->ai_protocol);
-    if (cb->sock_fd < 0) {
-      snprintf(connerr, sizeof(connerr), "failed to open socket: %s", STRERRNO);
-      continue;
-    }
-
-    set_sock_opts(cb->sock_fd);
-
-    status = connect(cb->sock_fd, ai_ptr->ai_addr, ai_ptr->ai_addrlen);
-    if (status != 0) {
-      snprintf(connerr, sizeof(connerr), "failed to connect to remote host: %s",
-               STRERRNO);
-      close(cb->sock_fd);
-      cb->sock_fd = -1;
-      continue;
-    }
-
-    break;
-  }
-
-  freeaddrinfo(ai_list);
-
-  if (cb->sock_fd < 0) {
-    c_complain(LOG_ERR, &cb->init_complaint,
-               "write_graphite plugin: Connecting to %s:%s via %s failed. "
-               "The last error was: %s",
-               cb->node, cb->service, cb->protocol, connerr);
-    return -1;
-  } else {
-    c_release(LOG_INFO, &cb->init_complaint,
-              "write_graphite plugin: Successfully connected to %s:%s via %s.",
-              cb->node, cb->service, cb->protocol);
+/* wg_pool returns the connection pool, creating it on first use so that its
+ * I/O thread is started after the daemon forked. Must hold cb->lock when
+ * calling. */
+static c_tcp_pool_t *wg_pool(struct wg_callback *cb) {
+  if (cb->pool != NULL)
+    return cb->pool;
+
+  c_tcp_pool_server_t *servers = calloc(cb->servers_num, sizeof(*servers));
+  if (servers == NULL) {
+    ERROR("write_graphite plugin: calloc failed.");
+    return NULL;
   }
-
-  /* wg_force_reconnect_check does not flush the buffer before closing a
-   * sending socket, so only call wg_reset_buffer() if the socket was closed
-   * for a different reason (tracked in cb->reconnect_interval_reached). */
-  if (!cb->reconnect_interval_reached || (cb->send_buf_free == 0))
-    wg_reset_buffer(cb);
-  else
-    cb->reconnect_interval_reached = false;
-
-  return 0;
+  for (size_t i = 0; i < cb->servers_num; i++)
+    servers[i] = (c_tcp_pool_server_t){
+        .node = cb->servers[i].node,
+        .service = cb->servers[i].service,
+    };
+
+  cb->pool = c_tcp_pool_create(&(c_tcp_pool_options_t){
+      .name = "write_graphite",
+      .servers = servers,
+      .servers_num = cb->servers_num,
+      .connections = (size_t)cb->connections,
+      .buffer_size = WG_SEND_BUF_SIZE,
+      .backlog_size = cb->backlog_size,
+      /* Look the servers up again whenever ReconnectInterval reopens the
+       * connections. */
+      .resolve_interval = cb->reconnect_interval,
+      .reconnect_interval = cb->reconnect_interval,
+      .udp = (strcasecmp("udp", cb->protocol) == 0),
+      .quiet_send_errors = !cb->log_send_errors,
+  });
+  sfree(servers);
+  if (cb->pool == NULL)
+    ERROR("write_graphite plugin: Creating the connection pool failed.");
+
+  return cb->pool;
 }
 
 static void wg_callback_free(void *data) {
@@ -289,14 +171,15 @@ static void wg_callback_free(void *data) {
 
   cb = data;
 
-  pthread_mutex_lock(&cb->send_lock);
-
-  wg_flush_nolock(/* timeout = */ 0, cb);
+  pthread_mutex_lock(&cb->lock);
+  /* Tries to send the buffered data for up to two seconds. */
+  c_tcp_pool_destroy(cb->pool);
 
-  if (cb->sock_fd >= 0) {
-    close(cb->sock_fd);
-    cb->sock_fd = -1;
+  for (size_t i = 0; i < cb->servers_num; i++) {
+    sfree(cb->servers[i].node);
+    sfree(cb->servers[i].service);
   }
+  sfree(cb->servers);
 
   sfree(cb->name);
   sfree(cb->node);
@@ -304,9 +187,10 @@ static void wg_callback_free(void *data) {
   sfree(cb->service);
   sfree(cb->prefix);
   sfree(cb->postfix);
+  graphite_cache_destroy(cb->name_cache);
 
-  pthread_mutex_unlock(&cb->send_lock);
-  pthread_mutex_destroy(&cb->send_lock);
+  pthread_mutex_unlock(&cb->lock);
+  pthread_mutex_destroy(&cb->lock);
 
   sfree(cb);
 }
@@ -315,79 +199,24 @@ static int wg_flush(cdtime_t timeout,
                     const char *identifier __attribute__((unused)),
                     user_data_t *user_data) {
   struct wg_callback *cb;
-  int status;
 
   if (user_data == NULL)
     return -EINVAL;
 
   cb = user_data->data;
 
-  pthread_mutex_lock(&cb->send_lock);
-
-  if (cb->sock_fd < 0) {
-    status = wg_callback_init(cb);
-    if (status != 0) {
-      /* An error message has already been printed. */
-      pthread_mutex_unlock(&cb->send_lock);
-      return -1;
-    }
-  }
-
-  status = wg_flush_nolock(timeout, cb);
-  pthread_mutex_unlock(&cb->send_lock);
-
-  return status;
-}
-
-static int wg_send_message(char const *message, struct wg_callback *cb) {
-  int status;
-  size_t message_len;
-
-  message_len = strlen(message);
-
-  pthread_mutex_lock(&cb->send_lock);
-
-  wg_force_reconnect_check(cb);
-
-  if (cb->sock_fd < 0) {
-    status = wg_callback_init(cb);
-    if (status != 0) {
-      /* An error message has already been printed. */
-      pthread_mutex_unlock(&cb->send_lock);
-      return -1;
-    }
-  }
-
-  if (message_len >= cb->send_buf_free) {
-    status = wg_flush_nolock(/* timeout = */ 0, cb);
-    if (status != 0) {
-      pthread_mutex_unlock(&cb->send_lock);
-      return status;
-    }
-  }
-
-  /* Assert that we have enough space for this message. */
-  assert(message_len < cb->send_buf_free);
-
-  /* `message_len + 1' because `message_len' does not include the
-   * trailing null byte. Neither does `send_buffer_fill'. */
-  memcpy(cb->send_buf + cb->send_buf_fill, message, message_len + 1);
-  cb->send_buf_fill += message_len;
-  cb->send_buf_free -= message_len;
-
-  DEBUG("write_graphite plugin: [%s]:%s (%s) buf %" PRIsz "/%" PRIsz
-        " (%.1f %%) \"%s\"",
-        cb->node, cb->service, cb->protocol, cb->send_buf_fill,
-        sizeof(cb->send_buf),
-        100.0 * ((double)cb->send_buf_fill) / ((double)sizeof(cb->send_buf)),
-        message);
-
-  pthread_mutex_unlock(&cb->send_lock);
+  pthread_mutex_lock(&cb->lock);
+  c_tcp_pool_t *pool = wg_pool(cb);
+  pthread_mutex_unlock(&cb->lock);
+  if (pool == NULL)
+    return -1;
 
+  c_tcp_pool_flush(pool, timeout);
   return 0;
 }
 
-static int wg_write_messages(const data_set_t *ds, const value_list_t *vl,
+/* NOTE: You must hold cb->lock when calling this function! */
+static int wg_write_messages_nolock(const data_set_t *ds, const value_list_t *vl,
                              struct wg_callback *cb) {
   char buffer[WG_SEND_BUF_SIZE] = {0};
   int status;
@@ -398,30 +227,51 @@ static int wg_write_messages(const data_set_t *ds, const value_list_t *vl,
     return -1;
   }
 
-  status = format_graphite(buffer, sizeof(buffer), ds, vl, cb->prefix,
-                           cb->postfix, cb->escape_char, cb->format_flags);
+  status = format_graphite_cached(buffer, sizeof(buffer), ds, vl, cb->prefix,
+                                  cb->postfix, cb->escape_char,
+                                  cb->format_flags, cb->name_cache);
   if (status != 0) /* error message has been printed already. */
     return status;
 
-  /* Send the message to graphite */
-  status = wg_send_message(buffer, cb);
-  if (status != 0) /* error message has been printed already. */
+  /* Send the message to graphite. With consistent hashing, all values of an
+   * identifier go to the same server and connection. */
+  if (cb->distribution == WG_DISTRIBUTION_CONSISTENT_HASH)
+    status = c_tcp_pool_send_hash(cb->pool, HASH_VL(vl), buffer,
+                                  strlen(buffer));
+  else
+    status = c_tcp_pool_send(cb->pool, buffer, strlen(buffer));
+  if (status != 0) {
+    ERROR("write_graphite plugin: Queueing the message failed: %s",
+          STRERROR(status));
     return status;
+  }
 
   return 0;
-} /* int wg_write_messages */
+} /* int wg_write_messages_nolock */
 
-static int wg_write(const data_set_t *ds, const value_list_t *vl,
-                    user_data_t *user_data) {
+static int wg_write_batch(write_batch_entry_t const *entries,
+                          size_t entries_num, user_data_t *user_data) {
   struct wg_callback *cb;
-  int status;
+  int status = 0;
 
   if (user_data == NULL)
     return EINVAL;
 
   cb = user_data->data;
 
-  status = wg_write_messages(ds, vl, cb);
+  pthread_mutex_lock(&cb->lock);
+  if (wg_pool(cb) == NULL) {
+    /* An error message has already been printed. */
+    pthread_mutex_unlock(&cb->lock);
+    return -1;
+  }
+
+  for (size_t i = 0; i < entries_num; i++) {
+    int tmp = wg_write_messages_nolock(entries[i].ds, entries[i].vl, cb);
+    if (tmp != 0)
+      status = tmp;
+  }
+  pthread_mutex_unlock(&cb->lock);
 
   return status;
 }
@@ -451,29 +301,94 @@ static int config_set_char(char *dest, oconfig_item_t *ci) {
   return 0;
 }
 
+static int wg_server_add(struct wg_callback *cb, char const *node,
+                         char const *service) {
+  wg_server_t *tmp =
+      realloc(cb->servers, (cb->servers_num + 1) * sizeof(*cb->servers));
+  if (tmp == NULL)
+    return ENOMEM;
+  cb->servers = tmp;
+
+  wg_server_t *s = cb->servers + cb->servers_num;
+  s->node = strdup(node);
+  s->service = strdup(service);
+  if ((s->node == NULL) || (s->service == NULL)) {
+    sfree(s->node);
+    sfree(s->service);
+    return ENOMEM;
+  }
+
+  cb->servers_num++;
+  return 0;
+}
+
+/* config_add_server handles "Server <host> [<port>]". */
+static int config_add_server(struct wg_callback *cb, oconfig_item_t *ci) {
+  if ((ci->values_num < 1) || (ci->values_num > 2) ||
+      (ci->values[0].type != OCONFIG_TYPE_STRING) ||
+      ((ci->values_num == 2) && (ci->values[1].type != OCONFIG_TYPE_STRING) &&
+       (ci->values[1].type != OCONFIG_TYPE_NUMBER))) {
+    ERROR("write_graphite plugin: The \"%s\" option needs a host and "
+          "optionally a port.",
+          ci->key);
+    return -1;
+  }
+
+  char service[32];
+  if (ci->values_num == 1)
+    sstrncpy(service, WG_DEFAULT_SERVICE, sizeof(service));
+  else if (ci->values[1].type == OCONFIG_TYPE_NUMBER)
+    snprintf(service, sizeof(service), "%d", (int)ci->values[1].value.number);
+  else
+    sstrncpy(service, ci->values[1].value.string, sizeof(service));
+
+  return wg_server_add(cb, ci->values[0].value.string, service);
+}
+
+static int config_set_distribution(struct wg_callback *cb,
+                                   oconfig_item_t *ci) {
+  char buffer[32];
+  int status = cf_util_get_string_buffer(ci, buffer, sizeof(buffer));
+  if (status != 0)
+    return status;
+
+  if (strcasecmp("RoundRobin", buffer) == 0)
+    cb->distribution = WG_DISTRIBUTION_ROUND_ROBIN;
+  else if (strcasecmp("ConsistentHash", buffer) == 0)
+    cb->distribution = WG_DISTRIBUTION_CONSISTENT_HASH;
+  else {
+    ERROR("write_graphite plugin: Unknown distribution (%s)", buffer);
+    return -1;
+  }
+
+  return 0;
+}
+
 static int wg_config_node(oconfig_item_t *ci) {
   struct wg_callback *cb;
   char callback_name[DATA_MAX_NAME_LEN];
   int status = 0;
+  double backlog_size = WG_DEFAULT_BACKLOG_SIZE;
 
   cb = calloc(1, sizeof(*cb));
   if (cb == NULL) {
     ERROR("write_graphite plugin: calloc failed.");
     return -1;
   }
-  cb->sock_fd = -1;
   cb->name = NULL;
   cb->node = strdup(WG_DEFAULT_NODE);
   cb->service = strdup(WG_DEFAULT_SERVICE);
   cb->protocol = strdup(WG_DEFAULT_PROTOCOL);
-  cb->last_reconnect_time = cdtime();
   cb->reconnect_interval = 0;
-  cb->reconnect_interval_reached = false;
   cb->log_send_errors = WG_DEFAULT_LOG_SEND_ERRORS;
   cb->prefix = NULL;
   cb->postfix = NULL;
   cb->escape_char = WG_DEFAULT_ESCAPE;
   cb->format_flags = GRAPHITE_STORE_RATES;
+  cb->connections = 1;
+  cb->distribution = WG_DISTRIBUTION_ROUND_ROBIN;
+
+  pthread_mutex_init(&cb->lock, /* attr = */ NULL);
 
   /* FIXME: Legacy configuration syntax. */
   if (strcasecmp("Carbon", ci->key) != 0) {
@@ -484,9 +399,6 @@ static int wg_config_node(oconfig_item_t *ci) {
     }
   }
 
-  pthread_mutex_init(&cb->send_lock, /* attr = */ NULL);
-  C_COMPLAIN_INIT(&cb->init_complaint);
-
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
 
@@ -494,6 +406,14 @@ static int wg_config_node(oconfig_item_t *ci) {
       cf_util_get_string(child, &cb->node);
     else if (strcasecmp("Port", child->key) == 0)
       cf_util_get_service(child, &cb->service);
+    else if (strcasecmp("Server", child->key) == 0)
+      status = config_add_server(cb, child);
+    else if (strcasecmp("Connections", child->key) == 0)
+      status = cf_util_get_int(child, &cb->connections);
+    else if (strcasecmp("Distribution", child->key) == 0)
+      status = config_set_distribution(cb, child);
+    else if (strcasecmp("BacklogSize", child->key) == 0)
+      status = cf_util_get_double(child, &backlog_size);
     else if (strcasecmp("Protocol", child->key) == 0) {
       cf_util_get_string(child, &cb->protocol);
 
@@ -526,6 +446,8 @@ static int wg_config_node(oconfig_item_t *ci) {
       cf_util_get_flag(child, &cb->format_flags, GRAPHITE_REVERSE_HOST);
     else if (strcasecmp("EscapeCharacter", child->key) == 0)
       config_set_char(&cb->escape_char, child);
+    else if (strcasecmp("MetricNameCacheSize", child->key) == 0)
+      status = cf_util_get_int(child, &cb->name_cache_size);
     else {
       ERROR("write_graphite plugin: Invalid configuration "
             "option: %s.",
@@ -542,6 +464,41 @@ static int wg_config_node(oconfig_item_t *ci) {
     return status;
   }
 
+  if (cb->connections < 1) {
+    ERROR("write_graphite plugin: Connections must be at least 1.");
+    wg_callback_free(cb);
+    return -1;
+  }
+
+  if (cb->name_cache_size < 0) {
+    ERROR("write_graphite plugin: MetricNameCacheSize must not be negative.");
+    wg_callback_free(cb);
+    return -1;
+  } else if (cb->name_cache_size > 0) {
+    cb->name_cache = graphite_cache_create((size_t)cb->name_cache_size);
+    if (cb->name_cache == NULL) {
+      ERROR("write_graphite plugin: graphite_cache_create failed.");
+      wg_callback_free(cb);
+      return -1;
+    }
+  }
+
+  if (!(backlog_size >= WG_SEND_BUF_SIZE)) {
+    ERROR("write_graphite plugin: BacklogSize must be at least %d bytes.",
+          WG_SEND_BUF_SIZE);
+    wg_callback_free(cb);
+    return -1;
+  }
+  cb->backlog_size = (size_t)backlog_size;
+
+  /* Without "Server" options, "Host" and "Port" name the only server. */
+  if ((cb->servers_num == 0) &&
+      (wg_server_add(cb, cb->node, cb->service) != 0)) {
+    ERROR("write_graphite plugin: malloc failed.");
+    wg_callback_free(cb);
+    return -1;
+  }
+
   /* FIXME: Legacy configuration syntax. */
   if (cb->name == NULL)
     snprintf(callback_name, sizeof(callback_name), "write_graphite/%s/%s/%s",
@@ -550,11 +507,12 @@ static int wg_config_node(oconfig_item_t *ci) {
     snprintf(callback_name, sizeof(callback_name), "write_graphite/%s",
              cb->name);
 
-  plugin_register_write(callback_name, wg_write,
-                        &(user_data_t){
-                            .data = cb,
-                            .free_func = wg_callback_free,
-                        });
+  plugin_register_write_batch(callback_name, wg_write_batch,
+                              /* batch_size = */ 0, /* max_age = */ 0,
+                              &(user_data_t){
+                                  .data = cb,
+                                  .free_func = wg_callback_free,
+                              });
 
   plugin_register_flush(callback_name, wg_flush, &(user_data_t){.data = cb});
 
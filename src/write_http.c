@@ -30,9 +30,14 @@
 #include "utils/curl_stats/curl_stats.h"
 #include "utils/format_json/format_json.h"
 #include "utils/format_kairosdb/format_kairosdb.h"
+#include "utils/spool/spool.h"
 
 #include <curl/curl.h>
 
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 #ifndef WRITE_HTTP_DEFAULT_BUFFER_SIZE
 #define WRITE_HTTP_DEFAULT_BUFFER_SIZE 4096
 #endif
@@ -45,9 +50,60 @@
 #define WRITE_HTTP_RESPONSE_BUFFER_SIZE 1024
 #endif
 
+#ifndef WRITE_HTTP_DEFAULT_SPOOL_SIZE
+#define WRITE_HTTP_DEFAULT_SPOOL_SIZE (64 * 1024 * 1024)
+#endif
+
+#ifndef WRITE_HTTP_DEFAULT_REPLAY_RATE
+#define WRITE_HTTP_DEFAULT_REPLAY_RATE 10.0
+#endif
+
+/* Outcomes of a request, as returned by wh_post_done(). */
+#define WH_POST_OK 0
+/* The server could not be reached or is unavailable; try again later. */
+#define WH_POST_RETRY 1
+/* The server rejected the request; sending it again won't help. */
+#define WH_POST_REJECTED 2
+
+/* curl_multi_poll() and curl_multi_wakeup() were added in 7.68.0. */
+#if LIBCURL_VERSION_NUM >= 0x074400
+#define HAVE_CURL_MULTI_POLL 1
+#endif
+
 /*
  * Private variables
  */
+typedef struct {
+  char buffer[WRITE_HTTP_RESPONSE_BUFFER_SIZE];
+  unsigned int pos;
+} wh_response_t;
+
+struct wh_callback_s;
+
+/* A request handed to the I/O thread. Finished requests are kept on the
+ * callback's idle list, so that their buffer and easy handle are reused. */
+struct wh_request_s {
+  struct wh_callback_s *cb;
+  CURL *curl;
+  char curl_errbuf[CURL_ERROR_SIZE];
+  wh_response_t response;
+
+  char *data;
+  size_t data_size;
+  size_t data_len;
+
+  /* Compressed copy of data, if "ContentEncoding" is "gzip". */
+  char *body;
+  size_t body_size;
+
+  /* Set for records replayed from the spool. */
+  bool replay;
+  c_spool_pos_t replay_pos;
+
+  struct wh_request_s *next;
+};
+typedef struct wh_request_s wh_request_t;
+
 struct wh_callback_s {
   char *name;
 
@@ -81,19 +137,51 @@ struct wh_callback_s {
   struct curl_slist *headers;
   char curl_errbuf[CURL_ERROR_SIZE];
 
-  char *send_buffer;
+  /* The send buffer grows as needed; it is sent once it holds
+   * send_buffer_size bytes. */
+  strbuf_t send_buffer;
   size_t send_buffer_size;
-  size_t send_buffer_free;
-  size_t send_buffer_fill;
   cdtime_t send_buffer_init_time;
 
   pthread_mutex_t send_lock;
 
-  char response_buffer[WRITE_HTTP_RESPONSE_BUFFER_SIZE];
-  unsigned int response_buffer_pos;
+  wh_response_t response;
+
+  bool compress;
+  char *body;
+  size_t body_size;
+
+  /* Bodies that could not be delivered are appended to the spool and replayed
+   * at up to replay_rate requests per second once the server accepts
+   * requests again. */
+  char *spool_dir;
+  double spool_size;
+  c_spool_t *spool;
+  uint64_t spool_dropped;
+  double replay_rate;
+  double replay_tokens;
+  cdtime_t replay_time;
+  bool replay_active;
+  bool healthy;
 
   int data_ttl;
   char *metrics_prefix;
+
+  /* With max_in_flight > 0, buffers are posted by an I/O thread driving
+   * "multi", so that write threads don't wait for the server. The queue and
+   * the idle list are protected by queue_lock. */
+  int max_in_flight;
+  CURLM *multi;
+  pthread_t io_thread;
+  bool io_thread_running;
+  bool io_stop;
+  pthread_mutex_t queue_lock;
+  pthread_cond_t queue_cond;
+  wh_request_t *queue_head;
+  wh_request_t *queue_tail;
+  size_t queue_num;
+  size_t in_flight;
+  wh_request_t *idle;
 };
 typedef struct wh_callback_s wh_callback_t;
 
@@ -106,21 +194,21 @@ static size_t http_attrs_num;
 static size_t wh_curl_write_callback(char *ptr, size_t size, size_t nmemb,
                                      void *userdata) {
 
-  wh_callback_t *cb = (wh_callback_t *)userdata;
+  wh_response_t *res = userdata;
   unsigned int len = 0;
 
-  if ((cb->response_buffer_pos + nmemb) > sizeof(cb->response_buffer))
-    len = sizeof(cb->response_buffer) - cb->response_buffer_pos;
+  if ((res->pos + nmemb) > sizeof(res->buffer))
+    len = sizeof(res->buffer) - res->pos;
   else
     len = nmemb;
 
   DEBUG(
       "write_http plugin: curl callback nmemb=%zu buffer_pos=%u write_len=%u ",
-      nmemb, cb->response_buffer_pos, len);
+      nmemb, res->pos, len);
 
-  memcpy(cb->response_buffer + cb->response_buffer_pos, ptr, len);
-  cb->response_buffer_pos += len;
-  cb->response_buffer[sizeof(cb->response_buffer) - 1] = '\0';
+  memcpy(res->buffer + res->pos, ptr, len);
+  res->pos += len;
+  res->buffer[sizeof(res->buffer) - 1] = '\0';
 
   /* Always return nmemb even if we write less so libcurl won't throw an error
    */
@@ -128,13 +216,13 @@ static size_t wh_curl_write_callback(char *ptr, size_t size, size_t nmemb,
 
 } /* }}} wh_curl_write_callback */
 
-static void wh_log_http_error(wh_callback_t *cb) {
+static void wh_log_http_error(wh_callback_t *cb, CURL *curl) {
   if (!cb->log_http_error)
     return;
 
   long http_code = 0;
 
-  curl_easy_getinfo(cb->curl, CURLINFO_RESPONSE_CODE, &http_code);
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
 
   if (http_code != 200)
     INFO("write_http plugin: HTTP Error code: %lu", http_code);
@@ -142,39 +230,25 @@ static void wh_log_http_error(wh_callback_t *cb) {
 
 static void wh_reset_buffer(wh_callback_t *cb) /* {{{ */
 {
-  if ((cb == NULL) || (cb->send_buffer == NULL))
+  if (cb == NULL)
     return;
 
-  memset(cb->send_buffer, 0, cb->send_buffer_size);
-  cb->send_buffer_free = cb->send_buffer_size;
-  cb->send_buffer_fill = 0;
+  strbuf_reset(&cb->send_buffer);
   cb->send_buffer_init_time = cdtime();
 
-  if (cb->format == WH_FORMAT_JSON || cb->format == WH_FORMAT_KAIROSDB) {
-    format_json_initialize(cb->send_buffer, &cb->send_buffer_fill,
-                           &cb->send_buffer_free);
-  }
-
-  memset(cb->response_buffer, 0, sizeof(cb->response_buffer));
-  cb->response_buffer_pos = 0;
+  memset(&cb->response, 0, sizeof(cb->response));
 
 } /* }}} wh_reset_buffer */
 
-/* must hold cb->send_lock when calling */
-static int wh_post_nolock(wh_callback_t *cb, char const *data) /* {{{ */
-{
-  int status = 0;
-
-  curl_easy_setopt(cb->curl, CURLOPT_URL, cb->location);
-  curl_easy_setopt(cb->curl, CURLOPT_POSTFIELDS, data);
-  curl_easy_setopt(cb->curl, CURLOPT_WRITEFUNCTION, &wh_curl_write_callback);
-  curl_easy_setopt(cb->curl, CURLOPT_WRITEDATA, (void *)cb);
-  status = curl_easy_perform(cb->curl);
-
-  wh_log_http_error(cb);
+/* wh_post_done logs the outcome of a POST request, dispatches the curl
+ * statistics and returns one of the WH_POST_* values. */
+static int wh_post_done(wh_callback_t *cb, CURL *curl, /* {{{ */
+                        CURLcode status, char const *errbuf,
+                        wh_response_t const *res) {
+  wh_log_http_error(cb, curl);
 
   if (cb->curl_stats != NULL) {
-    int rc = curl_stats_dispatch(cb->curl_stats, cb->curl, NULL, "write_http",
+    int rc = curl_stats_dispatch(cb->curl_stats, curl, NULL, "write_http",
                                  cb->name);
     if (rc != 0) {
       ERROR("write_http plugin: curl_stats_dispatch failed with "
@@ -186,41 +260,616 @@ static int wh_post_nolock(wh_callback_t *cb, char const *data) /* {{{ */
   if (status != CURLE_OK) {
     ERROR("write_http plugin: curl_easy_perform failed with "
           "status %i: %s",
-          status, cb->curl_errbuf);
-    if (strlen(cb->response_buffer) > 0) {
-      ERROR("write_http plugin: curl_response=%s", cb->response_buffer);
+          status, errbuf);
+    if (strlen(res->buffer) > 0) {
+      ERROR("write_http plugin: curl_response=%s", res->buffer);
     }
-  } else {
-    DEBUG("write_http plugin: curl_response=%s", cb->response_buffer);
+    return WH_POST_RETRY;
   }
+
+  DEBUG("write_http plugin: curl_response=%s", res->buffer);
+
+  long http_code = 0;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+  if ((http_code >= 500) || (http_code == 429))
+    return WH_POST_RETRY;
+  if (http_code >= 400)
+    return WH_POST_REJECTED;
+  return WH_POST_OK;
+} /* }}} wh_post_done */
+
+#if HAVE_ZLIB
+/* wh_gzip compresses data into *buffer, growing it as necessary. */
+static int wh_gzip(char const *data, size_t data_len, /* {{{ */
+                   char **buffer, size_t *buffer_size, size_t *ret_len) {
+  z_stream s = {0};
+  /* 15 + 16: the largest window, with a gzip header and trailer. */
+  if (deflateInit2(&s, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK)
+    return -1;
+
+  size_t need = (size_t)deflateBound(&s, (uLong)data_len);
+  if (*buffer_size < need) {
+    char *tmp = realloc(*buffer, need);
+    if (tmp == NULL) {
+      deflateEnd(&s);
+      return ENOMEM;
+    }
+    *buffer = tmp;
+    *buffer_size = need;
+  }
+
+  s.next_in = (Bytef *)data;
+  s.avail_in = (uInt)data_len;
+  s.next_out = (Bytef *)*buffer;
+  s.avail_out = (uInt)*buffer_size;
+
+  int status = deflate(&s, Z_FINISH);
+  *ret_len = (size_t)s.total_out;
+  deflateEnd(&s);
+
+  return (status == Z_STREAM_END) ? 0 : -1;
+} /* }}} int wh_gzip */
+#endif
+
+/* wh_set_body makes data the body of the next request on curl, compressing it
+ * into *buffer if requested. */
+static int wh_set_body(wh_callback_t *cb, CURL *curl, /* {{{ */
+                       char const *data, size_t data_len, char **buffer,
+                       size_t *buffer_size) {
+#if HAVE_ZLIB
+  if (cb->compress) {
+    size_t len = 0;
+    int status = wh_gzip(data, data_len, buffer, buffer_size, &len);
+    if (status != 0) {
+      ERROR("write_http plugin: Compressing the request body failed.");
+      return status;
+    }
+    data = *buffer;
+    data_len = len;
+  }
+#endif
+
+  curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data);
+  curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)data_len);
+  return 0;
+} /* }}} int wh_set_body */
+
+/* wh_spool_append stores a body that could not be delivered. */
+static void wh_spool_append(wh_callback_t *cb, char const *data, /* {{{ */
+                            size_t data_len) {
+  int status = c_spool_append(cb->spool, data, data_len);
+  if (status != 0) {
+    ERROR("write_http plugin: Spooling %" PRIsz " bytes for \"%s\" failed: %s",
+          data_len, cb->name, STRERROR(status));
+    return;
+  }
+
+  uint64_t dropped = c_spool_dropped(cb->spool);
+  if (dropped != cb->spool_dropped) {
+    WARNING("write_http plugin: The spool of \"%s\" is full. Dropped the "
+            "%" PRIu64 " oldest requests.",
+            cb->name, dropped - cb->spool_dropped);
+    cb->spool_dropped = dropped;
+  }
+} /* }}} void wh_spool_append */
+
+/* wh_replay_token implements a token bucket, allowing up to "SpoolReplayRate"
+ * replays per second with bursts of up to a second's worth. */
+static bool wh_replay_token(wh_callback_t *cb) /* {{{ */
+{
+  cdtime_t now = cdtime();
+  double burst = (cb->replay_rate > 1.0) ? cb->replay_rate : 1.0;
+
+  if (cb->replay_time == 0)
+    cb->replay_tokens = 1.0;
+  else
+    cb->replay_tokens +=
+        cb->replay_rate * CDTIME_T_TO_DOUBLE(now - cb->replay_time);
+  if (cb->replay_tokens > burst)
+    cb->replay_tokens = burst;
+  cb->replay_time = now;
+
+  if (cb->replay_tokens < 1.0)
+    return false;
+  cb->replay_tokens -= 1.0;
+  return true;
+} /* }}} bool wh_replay_token */
+
+/* wh_perform_nolock posts data using the callback's easy handle and returns
+ * the curl status. The outcome is stored in *ret_result.
+ * must hold cb->send_lock when calling */
+static int wh_perform_nolock(wh_callback_t *cb, char const *data, /* {{{ */
+                             size_t data_len, int *ret_result) {
+  curl_easy_setopt(cb->curl, CURLOPT_URL, cb->location);
+  curl_easy_setopt(cb->curl, CURLOPT_WRITEFUNCTION, &wh_curl_write_callback);
+  curl_easy_setopt(cb->curl, CURLOPT_WRITEDATA, (void *)&cb->response);
+  memset(&cb->response, 0, sizeof(cb->response));
+
+  int status =
+      wh_set_body(cb, cb->curl, data, data_len, &cb->body, &cb->body_size);
+  if (status != 0) {
+    *ret_result = WH_POST_RETRY;
+    return status;
+  }
+
+  status = curl_easy_perform(cb->curl);
+  *ret_result =
+      wh_post_done(cb, cb->curl, status, cb->curl_errbuf, &cb->response);
   return status;
-} /* }}} wh_post_nolock */
+} /* }}} int wh_perform_nolock */
 
-static int wh_callback_init(wh_callback_t *cb) /* {{{ */
+/* wh_replay_nolock posts spooled bodies, as far as the replay rate allows.
+ * must hold cb->send_lock when calling */
+static void wh_replay_nolock(wh_callback_t *cb) /* {{{ */
 {
-  if (cb->curl != NULL)
-    return 0;
+  while ((c_spool_records(cb->spool) > 0) && wh_replay_token(cb)) {
+    void *data = NULL;
+    size_t data_len = 0;
+    c_spool_pos_t pos;
 
-  cb->curl = curl_easy_init();
-  if (cb->curl == NULL) {
-    ERROR("curl plugin: curl_easy_init failed.");
-    return -1;
+    int status = c_spool_peek(cb->spool, &data, &data_len, &pos);
+    if (status != 0) {
+      if (status != ENOENT)
+        ERROR("write_http plugin: Reading the spool of \"%s\" failed: %s",
+              cb->name, STRERROR(status));
+      return;
+    }
+
+    int result = WH_POST_OK;
+    wh_perform_nolock(cb, data, data_len, &result);
+    sfree(data);
+
+    if (result == WH_POST_RETRY)
+      return;
+    if (result == WH_POST_REJECTED)
+      WARNING("write_http plugin: The server rejected a request replayed "
+              "from the spool of \"%s\". Dropping it.",
+              cb->name);
+    c_spool_consume(cb->spool, pos);
+  }
+} /* }}} void wh_replay_nolock */
+
+/* must hold cb->send_lock when calling */
+static int wh_post_nolock(wh_callback_t *cb, char const *data, /* {{{ */
+                          size_t data_len) {
+  int result = WH_POST_OK;
+  int status = wh_perform_nolock(cb, data, data_len, &result);
+
+  if (cb->spool != NULL) {
+    if (result == WH_POST_RETRY)
+      wh_spool_append(cb, data, data_len);
+    else
+      wh_replay_nolock(cb);
   }
 
+  return status;
+} /* }}} wh_post_nolock */
+
+/* wh_curl_setup sets the options shared by all requests of cb on curl. */
+static void wh_curl_setup(wh_callback_t *cb, CURL *curl, /* {{{ */
+                          char *errbuf) {
   if (cb->low_speed_limit > 0 && cb->low_speed_time > 0) {
-    curl_easy_setopt(cb->curl, CURLOPT_LOW_SPEED_LIMIT,
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT,
                      (long)(cb->low_speed_limit * cb->low_speed_time));
-    curl_easy_setopt(cb->curl, CURLOPT_LOW_SPEED_TIME,
-                     (long)cb->low_speed_time);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, (long)cb->low_speed_time);
   }
 
 #ifdef HAVE_CURLOPT_TIMEOUT_MS
   if (cb->timeout > 0)
-    curl_easy_setopt(cb->curl, CURLOPT_TIMEOUT_MS, (long)cb->timeout);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)cb->timeout);
+#endif
+
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_USERAGENT, COLLECTD_USERAGENT);
+
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, cb->headers);
+
+  curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, errbuf);
+  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 50L);
+
+  if (cb->user != NULL) {
+#ifdef HAVE_CURLOPT_USERNAME
+    curl_easy_setopt(curl, CURLOPT_USERNAME, cb->user);
+    curl_easy_setopt(curl, CURLOPT_PASSWORD,
+                     (cb->pass == NULL) ? "" : cb->pass);
+#else
+    curl_easy_setopt(curl, CURLOPT_USERPWD, cb->credentials);
+#endif
+    curl_easy_setopt(curl, CURLOPT_HTTPAUTH, CURLAUTH_ANY);
+  }
+
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, (long)cb->verify_peer);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, cb->verify_host ? 2L : 0L);
+  curl_easy_setopt(curl, CURLOPT_SSLVERSION, cb->sslversion);
+  if (cb->cacert != NULL)
+    curl_easy_setopt(curl, CURLOPT_CAINFO, cb->cacert);
+  if (cb->capath != NULL)
+    curl_easy_setopt(curl, CURLOPT_CAPATH, cb->capath);
+
+  if (cb->clientkey != NULL && cb->clientcert != NULL) {
+    curl_easy_setopt(curl, CURLOPT_SSLKEY, cb->clientkey);
+    curl_easy_setopt(curl, CURLOPT_SSLCERT, cb->clientcert);
+
+    if (cb->clientkeypass != NULL)
+      curl_easy_setopt(curl, CURLOPT_SSLKEYPASSWD, cb->clientkeypass);
+  }
+} /* }}} void wh_curl_setup */
+
+/*
+ * Asynchronous requests
+ *
+ * Write threads hand full buffers to the I/O thread of their node and carry
+ * on with a fresh buffer. The I/O thread keeps up to "MaxInFlight" requests
+ * running in a curl multi handle, which multiplexes them over a single
+ * HTTP/2 connection where the server supports it. A full queue blocks the
+ * write threads, which bounds the memory used while the server is slow.
+ * {{{ */
+static void wh_request_destroy(wh_request_t *r) {
+  if (r == NULL)
+    return;
+
+  if (r->curl != NULL)
+    curl_easy_cleanup(r->curl);
+  sfree(r->data);
+  sfree(r->body);
+  sfree(r);
+} /* void wh_request_destroy */
+
+/* wh_request_get returns an idle request or creates a new one. Must be
+ * called with queue_lock held. */
+static wh_request_t *wh_request_get(wh_callback_t *cb) {
+  wh_request_t *r = cb->idle;
+  if (r != NULL) {
+    cb->idle = r->next;
+    r->next = NULL;
+    return r;
+  }
+
+  r = calloc(1, sizeof(*r));
+  if (r == NULL)
+    return NULL;
+  r->cb = cb;
+
+  r->curl = curl_easy_init();
+  if (r->curl == NULL) {
+    ERROR("write_http plugin: curl_easy_init failed.");
+    sfree(r);
+    return NULL;
+  }
+
+  wh_curl_setup(cb, r->curl, r->curl_errbuf);
+  curl_easy_setopt(r->curl, CURLOPT_URL, cb->location);
+  curl_easy_setopt(r->curl, CURLOPT_WRITEFUNCTION, &wh_curl_write_callback);
+  curl_easy_setopt(r->curl, CURLOPT_WRITEDATA, (void *)&r->response);
+  curl_easy_setopt(r->curl, CURLOPT_PRIVATE, (void *)r);
+#if LIBCURL_VERSION_NUM >= 0x072b00 /* 7.43.0 */
+  /* Wait for a connection that can be multiplexed rather than opening a new
+   * one for every request. */
+  curl_easy_setopt(r->curl, CURLOPT_PIPEWAIT, 1L);
+#endif
+#ifdef CURL_HTTP_VERSION_2TLS
+  curl_easy_setopt(r->curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+#endif
+
+  return r;
+} /* wh_request_t *wh_request_get */
+
+/* wh_submit hands data to the I/O thread. If data is the send buffer, the
+ * request's buffer takes its place so that writers can go on. */
+static int wh_submit(wh_callback_t *cb, char *data, size_t data_len) /* {{{ */
+{
+  pthread_mutex_lock(&cb->queue_lock);
+
+  while ((cb->queue_num >= (size_t)cb->max_in_flight) && !cb->io_stop)
+    pthread_cond_wait(&cb->queue_cond, &cb->queue_lock);
+
+  wh_request_t *r = wh_request_get(cb);
+  if (r == NULL) {
+    pthread_mutex_unlock(&cb->queue_lock);
+    ERROR("write_http plugin: Allocating a request failed.");
+    return ENOMEM;
+  }
+
+  if (data == cb->send_buffer.ptr) {
+    /* Swap buffers: the request takes the send buffer and its old buffer
+     * becomes the new send buffer, which grows again if it is too small. */
+    char *buffer = r->data;
+    size_t buffer_size = (buffer != NULL) ? r->data_size : 0;
+
+    r->data = strbuf_release(&cb->send_buffer, NULL, &r->data_size);
+    cb->send_buffer.ptr = buffer;
+    cb->send_buffer.size = buffer_size;
+    strbuf_reset(&cb->send_buffer);
+    /* Failing here is not fatal: appending reports it. */
+    (void)strbuf_reserve(&cb->send_buffer, cb->send_buffer_size);
+  } else {
+    if (r->data_size < data_len + 1) {
+      char *tmp = realloc(r->data, data_len + 1);
+      if (tmp == NULL) {
+        r->next = cb->idle;
+        cb->idle = r;
+        pthread_mutex_unlock(&cb->queue_lock);
+        ERROR("write_http plugin: realloc failed.");
+        return ENOMEM;
+      }
+      r->data = tmp;
+      r->data_size = data_len + 1;
+    }
+    memcpy(r->data, data, data_len + 1);
+  }
+  r->data_len = data_len;
+  r->replay = false;
+
+  if (cb->queue_tail == NULL)
+    cb->queue_head = r;
+  else
+    cb->queue_tail->next = r;
+  cb->queue_tail = r;
+  cb->queue_num++;
+
+#if HAVE_CURL_MULTI_POLL
+  curl_multi_wakeup(cb->multi);
+#endif
+  pthread_mutex_unlock(&cb->queue_lock);
+
+  return 0;
+} /* }}} int wh_submit */
+
+/* wh_io_dequeue takes requests off the queue, as long as fewer than
+ * "MaxInFlight" are running, and returns them as a list. Must be called with
+ * queue_lock held. */
+static wh_request_t *wh_io_dequeue(wh_callback_t *cb) {
+  wh_request_t *head = NULL;
+  wh_request_t **tail = &head;
+
+  while ((cb->queue_head != NULL) &&
+         (cb->in_flight < (size_t)cb->max_in_flight)) {
+    wh_request_t *r = cb->queue_head;
+    cb->queue_head = r->next;
+    if (cb->queue_head == NULL)
+      cb->queue_tail = NULL;
+    cb->queue_num--;
+    cb->in_flight++;
+
+    r->next = NULL;
+    *tail = r;
+    tail = &r->next;
+  }
+
+  /* There is room in the queue again. */
+  pthread_cond_broadcast(&cb->queue_cond);
+  return head;
+} /* wh_request_t *wh_io_dequeue */
+
+/* wh_io_add hands a dequeued request to the multi handle. Compression happens
+ * here, so that it doesn't hold up the write threads. */
+static void wh_io_add(wh_callback_t *cb, wh_request_t *r) {
+  memset(&r->response, 0, sizeof(r->response));
+  r->curl_errbuf[0] = 0;
+
+  int status = wh_set_body(cb, r->curl, r->data, r->data_len, &r->body,
+                           &r->body_size);
+  if (status == 0) {
+    CURLMcode mstatus = curl_multi_add_handle(cb->multi, r->curl);
+    if (mstatus == CURLM_OK)
+      return;
+    ERROR("write_http plugin: curl_multi_add_handle failed: %s",
+          curl_multi_strerror(mstatus));
+  }
+
+  if (r->replay)
+    cb->replay_active = false;
+  else if (cb->spool != NULL)
+    wh_spool_append(cb, r->data, r->data_len);
+
+  pthread_mutex_lock(&cb->queue_lock);
+  r->next = cb->idle;
+  cb->idle = r;
+  cb->in_flight--;
+  pthread_mutex_unlock(&cb->queue_lock);
+} /* void wh_io_add */
+
+/* wh_io_replay starts replaying the oldest spooled body, unless the server
+ * is failing, a replay is already running or the replay rate has been
+ * reached. */
+static void wh_io_replay(wh_callback_t *cb) {
+  if ((cb->spool == NULL) || cb->replay_active || !cb->healthy ||
+      (c_spool_records(cb->spool) == 0) || !wh_replay_token(cb))
+    return;
+
+  void *data = NULL;
+  size_t data_len = 0;
+  c_spool_pos_t pos;
+  int status = c_spool_peek(cb->spool, &data, &data_len, &pos);
+  if (status != 0) {
+    if (status != ENOENT)
+      ERROR("write_http plugin: Reading the spool of \"%s\" failed: %s",
+            cb->name, STRERROR(status));
+    return;
+  }
+
+  pthread_mutex_lock(&cb->queue_lock);
+  wh_request_t *r = wh_request_get(cb);
+  if (r != NULL)
+    cb->in_flight++;
+  pthread_mutex_unlock(&cb->queue_lock);
+  if (r == NULL) {
+    ERROR("write_http plugin: Allocating a request failed.");
+    sfree(data);
+    return;
+  }
+
+  /* c_spool_peek() allocates one more byte for a terminating null byte. */
+  sfree(r->data);
+  r->data = data;
+  r->data_size = data_len + 1;
+  r->data_len = data_len;
+  r->replay = true;
+  r->replay_pos = pos;
+
+  cb->replay_active = true;
+  wh_io_add(cb, r);
+} /* void wh_io_replay */
+
+/* wh_io_finish handles the requests the multi handle is done with. */
+static void wh_io_finish(wh_callback_t *cb) {
+  CURLMsg *msg;
+  int msgs_left;
+
+  while ((msg = curl_multi_info_read(cb->multi, &msgs_left)) != NULL) {
+    if (msg->msg != CURLMSG_DONE)
+      continue;
+
+    wh_request_t *r = NULL;
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&r);
+    CURLcode status = msg->data.result;
+    curl_multi_remove_handle(cb->multi, msg->easy_handle);
+
+    int result =
+        wh_post_done(cb, r->curl, status, r->curl_errbuf, &r->response);
+    cb->healthy = (result != WH_POST_RETRY);
+
+    if (r->replay) {
+      cb->replay_active = false;
+      if (result == WH_POST_REJECTED)
+        WARNING("write_http plugin: The server rejected a request replayed "
+                "from the spool of \"%s\". Dropping it.",
+                cb->name);
+      if (result != WH_POST_RETRY)
+        c_spool_consume(cb->spool, r->replay_pos);
+    } else if ((cb->spool != NULL) && (result == WH_POST_RETRY)) {
+      wh_spool_append(cb, r->data, r->data_len);
+    }
+
+    pthread_mutex_lock(&cb->queue_lock);
+    r->next = cb->idle;
+    cb->idle = r;
+    cb->in_flight--;
+    pthread_mutex_unlock(&cb->queue_lock);
+  }
+} /* void wh_io_finish */
+
+static void *wh_io_thread(void *arg) /* {{{ */
+{
+  wh_callback_t *cb = arg;
+
+  while (true) {
+    pthread_mutex_lock(&cb->queue_lock);
+    wh_request_t *start = wh_io_dequeue(cb);
+    bool stop = cb->io_stop;
+    bool done = stop && (start == NULL) && (cb->queue_head == NULL) &&
+                (cb->in_flight == 0);
+    pthread_mutex_unlock(&cb->queue_lock);
+
+    if (done)
+      break;
+
+    while (start != NULL) {
+      wh_request_t *r = start;
+      start = r->next;
+      r->next = NULL;
+      wh_io_add(cb, r);
+    }
+    /* Spooled bodies stay on disk during shutdown. */
+    if (!stop)
+      wh_io_replay(cb);
+
+    int running = 0;
+    CURLMcode status = curl_multi_perform(cb->multi, &running);
+    if (status != CURLM_OK)
+      ERROR("write_http plugin: curl_multi_perform failed: %s",
+            curl_multi_strerror(status));
+
+    wh_io_finish(cb);
+
+    /* Wake up in time for the next replay. */
+    int timeout_ms = 1000;
+    if ((cb->spool != NULL) && cb->healthy && !cb->replay_active &&
+        (c_spool_records(cb->spool) > 0))
+      timeout_ms = (int)(1000.0 / cb->replay_rate) + 1;
+#if HAVE_CURL_MULTI_POLL
+    if (timeout_ms > 1000)
+      timeout_ms = 1000;
+    curl_multi_poll(cb->multi, NULL, 0, timeout_ms, NULL);
+#else
+    /* Without curl_multi_wakeup(), new requests are noticed after at most
+     * 100 ms. */
+    if (timeout_ms > 100)
+      timeout_ms = 100;
+    curl_multi_wait(cb->multi, NULL, 0, timeout_ms, NULL);
+#endif
+  }
+
+  return NULL;
+} /* }}} void *wh_io_thread */
+
+static int wh_io_init(wh_callback_t *cb) /* {{{ */
+{
+  cb->multi = curl_multi_init();
+  if (cb->multi == NULL) {
+    ERROR("write_http plugin: curl_multi_init failed.");
+    return -1;
+  }
+#ifdef CURLPIPE_MULTIPLEX
+  curl_multi_setopt(cb->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
 #endif
 
-  curl_easy_setopt(cb->curl, CURLOPT_NOSIGNAL, 1L);
-  curl_easy_setopt(cb->curl, CURLOPT_USERAGENT, COLLECTD_USERAGENT);
+  int status =
+      plugin_thread_create(&cb->io_thread, wh_io_thread, cb, "write_http io");
+  if (status != 0) {
+    ERROR("write_http plugin: Starting the I/O thread failed: %s",
+          STRERROR(status));
+    curl_multi_cleanup(cb->multi);
+    cb->multi = NULL;
+    return -1;
+  }
+  cb->io_thread_running = true;
+
+  return 0;
+} /* }}} int wh_io_init */
+
+/* wh_io_shutdown waits for the queued and running requests to finish and
+ * stops the I/O thread. */
+static void wh_io_shutdown(wh_callback_t *cb) /* {{{ */
+{
+  if (cb->io_thread_running) {
+    pthread_mutex_lock(&cb->queue_lock);
+    cb->io_stop = true;
+    pthread_cond_broadcast(&cb->queue_cond);
+#if HAVE_CURL_MULTI_POLL
+    curl_multi_wakeup(cb->multi);
+#endif
+    pthread_mutex_unlock(&cb->queue_lock);
+
+    pthread_join(cb->io_thread, NULL);
+    cb->io_thread_running = false;
+  }
+
+  while (cb->idle != NULL) {
+    wh_request_t *r = cb->idle;
+    cb->idle = r->next;
+    wh_request_destroy(r);
+  }
+
+  if (cb->multi != NULL) {
+    curl_multi_cleanup(cb->multi);
+    cb->multi = NULL;
+  }
+} /* }}} void wh_io_shutdown */
+/* }}} */
+
+static int wh_callback_init(wh_callback_t *cb) /* {{{ */
+{
+  if (cb->curl != NULL)
+    return 0;
+
+  cb->curl = curl_easy_init();
+  if (cb->curl == NULL) {
+    ERROR("curl plugin: curl_easy_init failed.");
+    return -1;
+  }
 
   cb->headers = curl_slist_append(cb->headers, "Accept:  */*");
   if (cb->format == WH_FORMAT_JSON || cb->format == WH_FORMAT_KAIROSDB)
@@ -229,18 +878,11 @@ static int wh_callback_init(wh_callback_t *cb) /* {{{ */
   else
     cb->headers = curl_slist_append(cb->headers, "Content-Type: text/plain");
   cb->headers = curl_slist_append(cb->headers, "Expect:");
-  curl_easy_setopt(cb->curl, CURLOPT_HTTPHEADER, cb->headers);
-
-  curl_easy_setopt(cb->curl, CURLOPT_ERRORBUFFER, cb->curl_errbuf);
-  curl_easy_setopt(cb->curl, CURLOPT_FOLLOWLOCATION, 1L);
-  curl_easy_setopt(cb->curl, CURLOPT_MAXREDIRS, 50L);
+  if (cb->compress)
+    cb->headers = curl_slist_append(cb->headers, "Content-Encoding: gzip");
 
+#ifndef HAVE_CURLOPT_USERNAME
   if (cb->user != NULL) {
-#ifdef HAVE_CURLOPT_USERNAME
-    curl_easy_setopt(cb->curl, CURLOPT_USERNAME, cb->user);
-    curl_easy_setopt(cb->curl, CURLOPT_PASSWORD,
-                     (cb->pass == NULL) ? "" : cb->pass);
-#else
     size_t credentials_size;
 
     credentials_size = strlen(cb->user) + 2;
@@ -255,39 +897,41 @@ static int wh_callback_init(wh_callback_t *cb) /* {{{ */
 
     snprintf(cb->credentials, credentials_size, "%s:%s", cb->user,
              (cb->pass == NULL) ? "" : cb->pass);
-    curl_easy_setopt(cb->curl, CURLOPT_USERPWD, cb->credentials);
-#endif
-    curl_easy_setopt(cb->curl, CURLOPT_HTTPAUTH, CURLAUTH_ANY);
   }
+#endif
 
-  curl_easy_setopt(cb->curl, CURLOPT_SSL_VERIFYPEER, (long)cb->verify_peer);
-  curl_easy_setopt(cb->curl, CURLOPT_SSL_VERIFYHOST, cb->verify_host ? 2L : 0L);
-  curl_easy_setopt(cb->curl, CURLOPT_SSLVERSION, cb->sslversion);
-  if (cb->cacert != NULL)
-    curl_easy_setopt(cb->curl, CURLOPT_CAINFO, cb->cacert);
-  if (cb->capath != NULL)
-    curl_easy_setopt(cb->curl, CURLOPT_CAPATH, cb->capath);
-
-  if (cb->clientkey != NULL && cb->clientcert != NULL) {
-    curl_easy_setopt(cb->curl, CURLOPT_SSLKEY, cb->clientkey);
-    curl_easy_setopt(cb->curl, CURLOPT_SSLCERT, cb->clientcert);
+  wh_curl_setup(cb, cb->curl, cb->curl_errbuf);
 
-    if (cb->clientkeypass != NULL)
-      curl_easy_setopt(cb->curl, CURLOPT_SSLKEYPASSWD, cb->clientkeypass);
-  }
+  if ((cb->max_in_flight > 0) && (wh_io_init(cb) != 0))
+    return -1;
 
   wh_reset_buffer(cb);
 
   return 0;
 } /* }}} int wh_callback_init */
 
+/* wh_send_nolock posts the send buffer, or hands it to the I/O thread, and
+ * resets it. must hold cb->send_lock when calling */
+static int wh_send_nolock(wh_callback_t *cb) /* {{{ */
+{
+  int status;
+
+  if (cb->io_thread_running)
+    status = wh_submit(cb, cb->send_buffer.ptr, cb->send_buffer.pos);
+  else
+    status = wh_post_nolock(cb, cb->send_buffer.ptr, cb->send_buffer.pos);
+
+  wh_reset_buffer(cb);
+  return status;
+} /* }}} int wh_send_nolock */
+
 static int wh_flush_nolock(cdtime_t timeout, wh_callback_t *cb) /* {{{ */
 {
   int status;
 
   DEBUG("write_http plugin: wh_flush_nolock: timeout = %.3f; "
-        "send_buffer_fill = %" PRIsz ";",
-        CDTIME_T_TO_DOUBLE(timeout), cb->send_buffer_fill);
+        "send_buffer.pos = %" PRIsz ";",
+        CDTIME_T_TO_DOUBLE(timeout), cb->send_buffer.pos);
 
   /* timeout == 0  => flush unconditionally */
   if (timeout > 0) {
@@ -299,30 +943,30 @@ static int wh_flush_nolock(cdtime_t timeout, wh_callback_t *cb) /* {{{ */
   }
 
   if (cb->format == WH_FORMAT_COMMAND) {
-    if (cb->send_buffer_fill == 0) {
+    if (cb->send_buffer.pos == 0) {
       cb->send_buffer_init_time = cdtime();
       return 0;
     }
 
-    status = wh_post_nolock(cb, cb->send_buffer);
-    wh_reset_buffer(cb);
+    status = wh_send_nolock(cb);
   } else if (cb->format == WH_FORMAT_JSON || cb->format == WH_FORMAT_KAIROSDB) {
-    if (cb->send_buffer_fill <= 2) {
+    if (cb->send_buffer.pos == 0) {
       cb->send_buffer_init_time = cdtime();
       return 0;
     }
 
-    status = format_json_finalize(cb->send_buffer, &cb->send_buffer_fill,
-                                  &cb->send_buffer_free);
+    if (cb->format == WH_FORMAT_JSON)
+      status = format_json_finalize_strbuf(&cb->send_buffer);
+    else
+      status = format_kairosdb_finalize(&cb->send_buffer);
     if (status != 0) {
       ERROR("write_http: wh_flush_nolock: "
-            "format_json_finalize failed.");
+            "Finalizing the send buffer failed.");
       wh_reset_buffer(cb);
       return status;
     }
 
-    status = wh_post_nolock(cb, cb->send_buffer);
-    wh_reset_buffer(cb);
+    status = wh_send_nolock(cb);
   } else {
     ERROR("write_http: wh_flush_nolock: "
           "Unknown format: %i",
@@ -367,9 +1011,16 @@ static void wh_callback_free(void *data) /* {{{ */
 
   cb = data;
 
-  if (cb->send_buffer != NULL)
+  if (cb->send_buffer.pos > 0)
     wh_flush_nolock(/* timeout = */ 0, cb);
 
+  wh_io_shutdown(cb);
+  pthread_cond_destroy(&cb->queue_cond);
+  pthread_mutex_destroy(&cb->queue_lock);
+
+  c_spool_destroy(cb->spool);
+  cb->spool = NULL;
+
   if (cb->curl != NULL) {
     curl_easy_cleanup(cb->curl);
     cb->curl = NULL;
@@ -393,15 +1044,18 @@ static void wh_callback_free(void *data) /* {{{ */
   sfree(cb->clientkey);
   sfree(cb->clientcert);
   sfree(cb->clientkeypass);
-  sfree(cb->send_buffer);
+  STRBUF_DESTROY(cb->send_buffer);
   sfree(cb->metrics_prefix);
+  sfree(cb->body);
+  sfree(cb->spool_dir);
 
   sfree(cb);
 } /* }}} void wh_callback_free */
 
-static int wh_write_command(const data_set_t *ds,
-                            const value_list_t *vl, /* {{{ */
-                            wh_callback_t *cb) {
+/* must hold cb->send_lock when calling */
+static int wh_write_command_nolock(const data_set_t *ds,
+                                   const value_list_t *vl, /* {{{ */
+                                   wh_callback_t *cb) {
   char key[10 * DATA_MAX_NAME_LEN];
   char values[512];
   char command[1024];
@@ -410,7 +1064,7 @@ static int wh_write_command(const data_set_t *ds,
   int status;
 
   /* sanity checks, primarily to make static analyzers happy. */
-  if ((cb == NULL) || (cb->send_buffer == NULL))
+  if (cb == NULL)
     return -1;
 
   if (strcmp(ds->type, vl->type) != 0) {
@@ -446,137 +1100,77 @@ static int wh_write_command(const data_set_t *ds,
     return -1;
   }
 
-  pthread_mutex_lock(&cb->send_lock);
-  if (wh_callback_init(cb) != 0) {
-    ERROR("write_http plugin: wh_callback_init failed.");
-    pthread_mutex_unlock(&cb->send_lock);
-    return -1;
-  }
-
-  if (command_len >= cb->send_buffer_free) {
+  /* Commands are never split, so send the buffer first if this one would
+   * make it exceed the configured size. */
+  if (cb->send_buffer.pos + command_len >= cb->send_buffer_size) {
     status = wh_flush_nolock(/* timeout = */ 0, cb);
-    if (status != 0) {
-      pthread_mutex_unlock(&cb->send_lock);
+    if (status != 0)
       return status;
-    }
   }
-  assert(command_len < cb->send_buffer_free);
-
-  /* Make scan-build happy. */
-  assert(cb->send_buffer != NULL);
 
-  /* `command_len + 1' because `command_len' does not include the
-   * trailing null byte. Neither does `send_buffer_fill'. */
-  memcpy(cb->send_buffer + cb->send_buffer_fill, command, command_len + 1);
-  cb->send_buffer_fill += command_len;
-  cb->send_buffer_free -= command_len;
+  if (strbuf_printn(&cb->send_buffer, command, command_len) != 0) {
+    ERROR("write_http plugin: Growing the send buffer failed.");
+    return ENOMEM;
+  }
 
   DEBUG("write_http plugin: <%s> buffer %" PRIsz "/%" PRIsz " (%g%%) \"%s\"",
-        cb->location, cb->send_buffer_fill, cb->send_buffer_size,
-        100.0 * ((double)cb->send_buffer_fill) / ((double)cb->send_buffer_size),
+        cb->location, cb->send_buffer.pos, cb->send_buffer_size,
+        100.0 * ((double)cb->send_buffer.pos) / ((double)cb->send_buffer_size),
         command);
 
-  /* Check if we have enough space for this command. */
-  pthread_mutex_unlock(&cb->send_lock);
-
   return 0;
-} /* }}} int wh_write_command */
+} /* }}} int wh_write_command_nolock */
 
-static int wh_write_json(const data_set_t *ds, const value_list_t *vl, /* {{{ */
-                         wh_callback_t *cb) {
+/* must hold cb->send_lock when calling */
+static int wh_write_json_nolock(const data_set_t *ds,
+                                const value_list_t *vl, /* {{{ */
+                                wh_callback_t *cb) {
   int status;
 
-  pthread_mutex_lock(&cb->send_lock);
-  if (wh_callback_init(cb) != 0) {
-    ERROR("write_http plugin: wh_callback_init failed.");
-    pthread_mutex_unlock(&cb->send_lock);
-    return -1;
-  }
-
-  status =
-      format_json_value_list(cb->send_buffer, &cb->send_buffer_fill,
-                             &cb->send_buffer_free, ds, vl, cb->store_rates);
-  if (status == -ENOMEM) {
-    status = wh_flush_nolock(/* timeout = */ 0, cb);
-    if (status != 0) {
-      wh_reset_buffer(cb);
-      pthread_mutex_unlock(&cb->send_lock);
-      return status;
-    }
-
-    status =
-        format_json_value_list(cb->send_buffer, &cb->send_buffer_fill,
-                               &cb->send_buffer_free, ds, vl, cb->store_rates);
-  }
-  if (status != 0) {
-    pthread_mutex_unlock(&cb->send_lock);
+  status = format_json_value_list_strbuf(&cb->send_buffer, ds, vl,
+                                         cb->store_rates);
+  if (status != 0)
     return status;
-  }
 
   DEBUG("write_http plugin: <%s> buffer %" PRIsz "/%" PRIsz " (%g%%)",
-        cb->location, cb->send_buffer_fill, cb->send_buffer_size,
-        100.0 * ((double)cb->send_buffer_fill) /
+        cb->location, cb->send_buffer.pos, cb->send_buffer_size,
+        100.0 * ((double)cb->send_buffer.pos) /
             ((double)cb->send_buffer_size));
 
-  /* Check if we have enough space for this command. */
-  pthread_mutex_unlock(&cb->send_lock);
+  if (cb->send_buffer.pos >= cb->send_buffer_size)
+    return wh_flush_nolock(/* timeout = */ 0, cb);
 
   return 0;
-} /* }}} int wh_write_json */
+} /* }}} int wh_write_json_nolock */
 
-static int wh_write_kairosdb(const data_set_t *ds,
-                             const value_list_t *vl, /* {{{ */
-                             wh_callback_t *cb) {
+/* must hold cb->send_lock when calling */
+static int wh_write_kairosdb_nolock(const data_set_t *ds,
+                                    const value_list_t *vl, /* {{{ */
+                                    wh_callback_t *cb) {
   int status;
 
-  pthread_mutex_lock(&cb->send_lock);
-
-  if (cb->curl == NULL) {
-    status = wh_callback_init(cb);
-    if (status != 0) {
-      ERROR("write_http plugin: wh_callback_init failed.");
-      pthread_mutex_unlock(&cb->send_lock);
-      return -1;
-    }
-  }
-
   status = format_kairosdb_value_list(
-      cb->send_buffer, &cb->send_buffer_fill, &cb->send_buffer_free, ds, vl,
-      cb->store_rates, (char const *const *)http_attrs, http_attrs_num,
-      cb->data_ttl, cb->metrics_prefix);
-  if (status == -ENOMEM) {
-    status = wh_flush_nolock(/* timeout = */ 0, cb);
-    if (status != 0) {
-      wh_reset_buffer(cb);
-      pthread_mutex_unlock(&cb->send_lock);
-      return status;
-    }
-
-    status = format_kairosdb_value_list(
-        cb->send_buffer, &cb->send_buffer_fill, &cb->send_buffer_free, ds, vl,
-        cb->store_rates, (char const *const *)http_attrs, http_attrs_num,
-        cb->data_ttl, cb->metrics_prefix);
-  }
-  if (status != 0) {
-    pthread_mutex_unlock(&cb->send_lock);
+      &cb->send_buffer, ds, vl, cb->store_rates,
+      (char const *const *)http_attrs, http_attrs_num, cb->data_ttl,
+      cb->metrics_prefix);
+  if (status != 0)
     return status;
-  }
 
   DEBUG("write_http plugin: <%s> buffer %" PRIsz "/%" PRIsz " (%g%%)",
-        cb->location, cb->send_buffer_fill, cb->send_buffer_size,
-        100.0 * ((double)cb->send_buffer_fill) /
+        cb->location, cb->send_buffer.pos, cb->send_buffer_size,
+        100.0 * ((double)cb->send_buffer.pos) /
             ((double)cb->send_buffer_size));
 
-  /* Check if we have enough space for this command. */
-  pthread_mutex_unlock(&cb->send_lock);
+  if (cb->send_buffer.pos >= cb->send_buffer_size)
+    return wh_flush_nolock(/* timeout = */ 0, cb);
 
   return 0;
-} /* }}} int wh_write_kairosdb */
+} /* }}} int wh_write_kairosdb_nolock */
 
-static int wh_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
-                    user_data_t *user_data) {
+static int wh_write_batch(write_batch_entry_t const *entries, /* {{{ */
+                          size_t entries_num, user_data_t *user_data) {
   wh_callback_t *cb;
-  int status;
+  int status = 0;
 
   if (user_data == NULL)
     return -EINVAL;
@@ -584,19 +1178,36 @@ static int wh_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
   cb = user_data->data;
   assert(cb->send_metrics);
 
-  switch (cb->format) {
-  case WH_FORMAT_JSON:
-    status = wh_write_json(ds, vl, cb);
-    break;
-  case WH_FORMAT_KAIROSDB:
-    status = wh_write_kairosdb(ds, vl, cb);
-    break;
-  default:
-    status = wh_write_command(ds, vl, cb);
-    break;
+  pthread_mutex_lock(&cb->send_lock);
+  if (wh_callback_init(cb) != 0) {
+    ERROR("write_http plugin: wh_callback_init failed.");
+    pthread_mutex_unlock(&cb->send_lock);
+    return -1;
   }
+
+  for (size_t i = 0; i < entries_num; i++) {
+    const data_set_t *ds = entries[i].ds;
+    const value_list_t *vl = entries[i].vl;
+    int tmp;
+
+    switch (cb->format) {
+    case WH_FORMAT_JSON:
+      tmp = wh_write_json_nolock(ds, vl, cb);
+      break;
+    case WH_FORMAT_KAIROSDB:
+      tmp = wh_write_kairosdb_nolock(ds, vl, cb);
+      break;
+    default:
+      tmp = wh_write_command_nolock(ds, vl, cb);
+      break;
+    }
+    if (tmp != 0)
+      status = tmp;
+  }
+
+  pthread_mutex_unlock(&cb->send_lock);
   return status;
-} /* }}} int wh_write */
+} /* }}} int wh_write_batch */
 
 static int wh_notify(notification_t const *n, user_data_t *ud) /* {{{ */
 {
@@ -623,7 +1234,10 @@ static int wh_notify(notification_t const *n, user_data_t *ud) /* {{{ */
     return -1;
   }
 
-  status = wh_post_nolock(cb, alert);
+  if (cb->io_thread_running)
+    status = wh_submit(cb, alert, strlen(alert));
+  else
+    status = wh_post_nolock(cb, alert, strlen(alert));
   pthread_mutex_unlock(&cb->send_lock);
 
   return status;
@@ -655,6 +1269,29 @@ static int config_set_format(wh_callback_t *cb, /* {{{ */
   return 0;
 } /* }}} int config_set_format */
 
+static int config_set_content_encoding(wh_callback_t *cb, /* {{{ */
+                                       oconfig_item_t *ci) {
+  char *string = NULL;
+  int status = cf_util_get_string(ci, &string);
+  if (status != 0)
+    return status;
+
+  if (strcasecmp("identity", string) == 0)
+    cb->compress = false;
+#if HAVE_ZLIB
+  else if (strcasecmp("gzip", string) == 0)
+    cb->compress = true;
+#endif
+  else {
+    ERROR("write_http plugin: Invalid or unsupported content encoding: %s",
+          string);
+    status = -1;
+  }
+
+  sfree(string);
+  return status;
+} /* }}} int config_set_content_encoding */
+
 static int wh_config_append_string(const char *name,
                                    struct curl_slist **dest, /* {{{ */
                                    oconfig_item_t *ci) {
@@ -698,6 +1335,9 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
   cb->data_ttl = 0;
   cb->metrics_prefix = strdup(WRITE_HTTP_DEFAULT_PREFIX);
   cb->curl_stats = NULL;
+  cb->spool_size = WRITE_HTTP_DEFAULT_SPOOL_SIZE;
+  cb->replay_rate = WRITE_HTTP_DEFAULT_REPLAY_RATE;
+  cb->healthy = true;
 
   if (cb->metrics_prefix == NULL) {
     ERROR("write_http plugin: strdup failed.");
@@ -706,6 +1346,8 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
   }
 
   pthread_mutex_init(&cb->send_lock, /* attr = */ NULL);
+  pthread_mutex_init(&cb->queue_lock, /* attr = */ NULL);
+  pthread_cond_init(&cb->queue_cond, /* attr = */ NULL);
 
   cf_util_get_string(ci, &cb->name);
 
@@ -770,6 +1412,14 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
       sfree(value);
     } else if (strcasecmp("Format", child->key) == 0)
       status = config_set_format(cb, child);
+    else if (strcasecmp("ContentEncoding", child->key) == 0)
+      status = config_set_content_encoding(cb, child);
+    else if (strcasecmp("SpoolDirectory", child->key) == 0)
+      status = cf_util_get_string(child, &cb->spool_dir);
+    else if (strcasecmp("SpoolSize", child->key) == 0)
+      status = cf_util_get_double(child, &cb->spool_size);
+    else if (strcasecmp("SpoolReplayRate", child->key) == 0)
+      status = cf_util_get_double(child, &cb->replay_rate);
     else if (strcasecmp("Metrics", child->key) == 0)
       cf_util_get_boolean(child, &cb->send_metrics);
     else if (strcasecmp("Statistics", child->key) == 0) {
@@ -786,6 +1436,8 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_int(child, &cb->low_speed_limit);
     else if (strcasecmp("Timeout", child->key) == 0)
       status = cf_util_get_int(child, &cb->timeout);
+    else if (strcasecmp("MaxInFlight", child->key) == 0)
+      status = cf_util_get_int(child, &cb->max_in_flight);
     else if (strcasecmp("LogHttpError", child->key) == 0)
       status = cf_util_get_boolean(child, &cb->log_http_error);
     else if (strcasecmp("Header", child->key) == 0)
@@ -851,6 +1503,41 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
     return -1;
   }
 
+  if (cb->max_in_flight < 0) {
+    ERROR("write_http plugin: MaxInFlight must not be negative.");
+    wh_callback_free(cb);
+    return -1;
+  }
+
+  if (!(cb->replay_rate > 0.0)) {
+    ERROR("write_http plugin: SpoolReplayRate must be positive.");
+    wh_callback_free(cb);
+    return -1;
+  }
+
+  if (cb->spool_dir != NULL) {
+    if (!(cb->spool_size >= 65536.0)) {
+      ERROR("write_http plugin: SpoolSize must be at least 65536 bytes.");
+      wh_callback_free(cb);
+      return -1;
+    }
+
+    cb->spool = c_spool_create(cb->spool_dir, (uint64_t)cb->spool_size,
+                               /* segment_size = */ 0);
+    if (cb->spool == NULL) {
+      ERROR("write_http plugin: Opening the spool \"%s\" failed.",
+            cb->spool_dir);
+      wh_callback_free(cb);
+      return -1;
+    }
+
+    uint64_t records = c_spool_records(cb->spool);
+    if (records > 0)
+      INFO("write_http plugin: %" PRIu64 " spooled requests for \"%s\" "
+           "will be replayed.",
+           records, cb->name);
+  }
+
   if (strlen(cb->metrics_prefix) == 0)
     sfree(cb->metrics_prefix);
 
@@ -865,16 +1552,15 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
     ERROR("write_http plugin: Ignoring invalid BufferSize setting (%d).",
           buffer_size);
 
-  /* Allocate the buffer. */
-  cb->send_buffer = malloc(cb->send_buffer_size);
-  if (cb->send_buffer == NULL) {
-    ERROR("write_http plugin: malloc(%" PRIsz ") failed.",
+  /* Allocate the buffer up front; it only grows beyond this when a value list
+   * pushes it over the limit. */
+  if (strbuf_reserve(&cb->send_buffer, cb->send_buffer_size) != 0) {
+    ERROR("write_http plugin: Allocating a %" PRIsz " byte buffer failed.",
           cb->send_buffer_size);
     wh_callback_free(cb);
     return -1;
   }
 
-  /* Nulls the buffer and sets ..._free and ..._fill. */
   wh_reset_buffer(cb);
 
   snprintf(callback_name, sizeof(callback_name), "write_http/%s", cb->name);
@@ -887,7 +1573,9 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
   };
 
   if (cb->send_metrics) {
-    plugin_register_write(callback_name, wh_write, &user_data);
+    plugin_register_write_batch(callback_name, wh_write_batch,
+                                /* batch_size = */ 0, /* max_age = */ 0,
+                                &user_data);
     user_data.free_func = NULL;
 
     plugin_register_flush(callback_name, wh_flush, &user_data);
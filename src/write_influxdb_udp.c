@@ -23,10 +23,13 @@
  *   Carlos Peon Costa <carlospeon at gmail.com>
  **/
 
+#define _GNU_SOURCE /* For sendmmsg */
+
 #include "collectd.h"
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/ring/ring.h"
 #include "utils_cache.h"
 #include "utils_complain.h"
 
@@ -65,6 +68,26 @@ typedef struct sockent {
 #define NET_DEFAULT_PACKET_SIZE 1452
 #define NET_DEFAULT_PORT "8089"
 
+/* Number of completed packets that may wait to be sent, and the number of
+ * packets sent with one sendmmsg(2). */
+#define SEND_QUEUE_SIZE 64
+#define SEND_BATCH_MAX 32
+
+typedef struct {
+  char *data;
+  size_t size;
+} wifxudp_packet_t;
+
+/* Each write thread builds packets in its own buffer. Completed packets are
+ * moved to `send_queue'. */
+typedef struct wifxudp_buffer_s {
+  char *packet;
+  size_t fill;
+  cdtime_t last_update;
+  pthread_mutex_t lock;
+  struct wifxudp_buffer_s *next;
+} wifxudp_buffer_t;
+
 /*
  * Private variables
  */
@@ -75,12 +98,16 @@ static bool wifxudp_config_store_rates;
 
 static sockent_t *sending_socket;
 
-/* Buffer in which to-be-sent network packets are constructed. */
-static char *send_buffer;
-static char *send_buffer_ptr;
-static int send_buffer_fill;
-static cdtime_t send_buffer_last_update;
-static pthread_mutex_t send_buffer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t send_buffer_key;
+static wifxudp_buffer_t *send_buffers;
+static pthread_mutex_t send_buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Completed packets waiting to be sent, and sent packets kept for re-use.
+ * `send_lock' is held by the thread sending the queued packets and protects
+ * `sending_socket'. */
+static c_ring_t *send_queue;
+static c_ring_t *free_packets;
+static pthread_mutex_t send_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static int set_ttl(const sockent_t *se, const struct addrinfo *ai) {
 
@@ -288,13 +315,7 @@ static void sockent_destroy(sockent_t *se) {
   }
 } /* void sockent_destroy */
 
-static void write_influxdb_udp_init_buffer(void) {
-  memset(send_buffer, 0, wifxudp_config_packet_size);
-  send_buffer_ptr = send_buffer;
-  send_buffer_fill = 0;
-  send_buffer_last_update = 0;
-} /* write_influxdb_udp_init_buffer */
-
+/* Sends one packet. The caller must hold `send_lock'. */
 static void write_influxdb_udp_send_buffer(const char *buffer,
                                            size_t buffer_size) {
   while (42) {
@@ -321,10 +342,161 @@ static void write_influxdb_udp_send_buffer(const char *buffer,
   } /* while (42) */
 } /* void write_influxdb_udp_send_buffer */
 
-static void flush_buffer(void) {
-  write_influxdb_udp_send_buffer(send_buffer, (size_t)send_buffer_fill);
-  write_influxdb_udp_init_buffer();
-}
+/* Sends `packets_num' packets with as few system calls as possible. The caller
+ * must hold `send_lock'. */
+static void wifxudp_send_packets(const wifxudp_packet_t *packets, /* {{{ */
+                                 size_t packets_num) {
+#if HAVE_SENDMMSG
+  if (packets_num == 1) {
+    write_influxdb_udp_send_buffer(packets[0].data, packets[0].size);
+    return;
+  }
+
+  if (sockent_client_connect(sending_socket) != 0)
+    return;
+
+  struct sockent_client *client = &sending_socket->client;
+  struct mmsghdr msgs[SEND_BATCH_MAX];
+  struct iovec iov[SEND_BATCH_MAX];
+
+  assert(packets_num <= SEND_BATCH_MAX);
+  for (size_t i = 0; i < packets_num; i++) {
+    iov[i] = (struct iovec){.iov_base = packets[i].data,
+                            .iov_len = packets[i].size};
+    msgs[i] = (struct mmsghdr){
+        .msg_hdr =
+            {
+                .msg_name = client->addr,
+                .msg_namelen = client->addrlen,
+                .msg_iov = iov + i,
+                .msg_iovlen = 1,
+            },
+    };
+  }
+
+  size_t sent = 0;
+  while (sent < packets_num) {
+    int status = sendmmsg(client->fd, msgs + sent,
+                          (unsigned int)(packets_num - sent), /* flags = */ 0);
+    if (status < 0) {
+      if ((errno == EINTR) || (errno == EAGAIN))
+        continue;
+
+      ERROR("write_influxdb_udp plugin: "
+            "sendmmsg failed: %s. Closing sending socket.",
+            STRERRNO);
+      sockent_client_disconnect(sending_socket);
+      return;
+    }
+    sent += (size_t)status;
+  }
+#else
+  for (size_t i = 0; i < packets_num; i++)
+    write_influxdb_udp_send_buffer(packets[i].data, packets[i].size);
+#endif
+} /* }}} void wifxudp_send_packets */
+
+static char *wifxudp_packet_get(void) /* {{{ */
+{
+  char *packet;
+  if (c_ring_pop(free_packets, &packet) == 0)
+    return packet;
+
+  packet = malloc(wifxudp_config_packet_size);
+  if (packet == NULL)
+    ERROR("write_influxdb_udp plugin: malloc failed.");
+  return packet;
+} /* }}} char *wifxudp_packet_get */
+
+static void wifxudp_packet_put(char *packet) /* {{{ */
+{
+  if (c_ring_push(free_packets, &packet) != 0)
+    free(packet);
+} /* }}} void wifxudp_packet_put */
+
+/* Sends the queued packets. Only one thread sends at a time; unless `wait' is
+ * true, a thread finding another one sending leaves its packets to that
+ * thread. */
+static void wifxudp_send_queue(bool wait) /* {{{ */
+{
+  do {
+    if (wait)
+      pthread_mutex_lock(&send_lock);
+    else if (pthread_mutex_trylock(&send_lock) != 0)
+      return;
+
+    wifxudp_packet_t batch[SEND_BATCH_MAX];
+    size_t batch_num;
+    do {
+      batch_num = 0;
+      while ((batch_num < SEND_BATCH_MAX) &&
+             (c_ring_pop(send_queue, batch + batch_num) == 0))
+        batch_num++;
+
+      if (batch_num > 0)
+        wifxudp_send_packets(batch, batch_num);
+      for (size_t i = 0; i < batch_num; i++)
+        wifxudp_packet_put(batch[i].data);
+    } while (batch_num == SEND_BATCH_MAX);
+
+    pthread_mutex_unlock(&send_lock);
+
+    /* A packet queued by a thread that failed to take the lock after our last
+     * pop would be stuck until the next packet is completed. */
+  } while (c_ring_size(send_queue) > 0);
+} /* }}} void wifxudp_send_queue */
+
+/* Moves the packet in `sb' to the send queue. The caller must hold
+ * `sb->lock'. */
+static void wifxudp_buffer_complete(wifxudp_buffer_t *sb) /* {{{ */
+{
+  char *packet = wifxudp_packet_get();
+  if (packet == NULL) {
+    /* Send the packet right away and keep using the buffer. */
+    pthread_mutex_lock(&send_lock);
+    write_influxdb_udp_send_buffer(sb->packet, sb->fill);
+    pthread_mutex_unlock(&send_lock);
+  } else {
+    wifxudp_packet_t p = {.data = sb->packet, .size = sb->fill};
+    while (c_ring_push(send_queue, &p) != 0)
+      wifxudp_send_queue(/* wait = */ true);
+    sb->packet = packet;
+  }
+
+  sb->fill = 0;
+  sb->last_update = 0;
+} /* }}} void wifxudp_buffer_complete */
+
+/* Returns the calling thread's send buffer, creating it on first use. */
+static wifxudp_buffer_t *wifxudp_buffer_get(void) /* {{{ */
+{
+  wifxudp_buffer_t *sb = pthread_getspecific(send_buffer_key);
+  if (sb != NULL)
+    return sb;
+
+  sb = calloc(1, sizeof(*sb));
+  if (sb == NULL) {
+    ERROR("write_influxdb_udp plugin: calloc failed.");
+    return NULL;
+  }
+
+  sb->packet = wifxudp_packet_get();
+  if (sb->packet == NULL) {
+    sfree(sb);
+    return NULL;
+  }
+  pthread_mutex_init(&sb->lock, /* attr = */ NULL);
+
+  /* The buffers are owned by the list, which is freed at shutdown, after the
+   * write threads are gone. */
+  pthread_mutex_lock(&send_buffers_lock);
+  sb->next = send_buffers;
+  send_buffers = sb;
+  pthread_mutex_unlock(&send_buffers_lock);
+
+  pthread_setspecific(send_buffer_key, sb);
+  return sb;
+} /* }}} wifxudp_buffer_t *wifxudp_buffer_get */
 
 static int wifxudp_escape_string(char *buffer, size_t buffer_size,
                                  const char *string) {
@@ -368,7 +540,8 @@ static int write_influxdb_point(char *buffer, int buffer_len,
                                 const data_set_t *ds, const value_list_t *vl) {
   int status;
   int offset = 0;
-  gauge_t *rates = NULL;
+  gauge_t const *rates = NULL;
+  gauge_t *rates_alloc = NULL;
   bool have_values = false;
 
   assert(0 == strcmp(ds->type, vl->type));
@@ -386,7 +559,7 @@ static int write_influxdb_point(char *buffer, int buffer_len,
   do {                                                                         \
     status = snprintf(buffer + offset, buffer_len - offset, __VA_ARGS__);      \
     if ((status < 0) || (status >= (buffer_len - offset))) {                   \
-      sfree(rates);                                                            \
+      sfree(rates_alloc);                                                      \
       return -1;                                                               \
     }                                                                          \
     offset += status;                                                          \
@@ -414,7 +587,7 @@ static int write_influxdb_point(char *buffer, int buffer_len,
         (ds->ds[i].type != DS_TYPE_GAUGE) &&
         (ds->ds[i].type != DS_TYPE_DERIVE) &&
         (ds->ds[i].type != DS_TYPE_ABSOLUTE)) {
-      sfree(rates);
+      sfree(rates_alloc);
       return -1;
     }
 
@@ -427,7 +600,7 @@ static int write_influxdb_point(char *buffer, int buffer_len,
       have_values = true;
     } else if (wifxudp_config_store_rates) {
       if (rates == NULL)
-        rates = uc_get_rate(ds, vl);
+        rates = uc_get_rate_attached(ds, vl, &rates_alloc);
       if (rates == NULL) {
         WARNING("write_influxdb_udp plugin: "
                 "uc_get_rate failed.");
@@ -458,7 +631,7 @@ static int write_influxdb_point(char *buffer, int buffer_len,
     }
 
   } /* for ds->ds_num */
-  sfree(rates);
+  sfree(rates_alloc);
 
   if (!have_values)
     return 0;
@@ -474,33 +647,48 @@ static int write_influxdb_point(char *buffer, int buffer_len,
 static int
 write_influxdb_udp_write(const data_set_t *ds, const value_list_t *vl,
                          user_data_t __attribute__((unused)) * user_data) {
-  char buffer[NET_DEFAULT_PACKET_SIZE];
-
-  int status = write_influxdb_point(buffer, NET_DEFAULT_PACKET_SIZE, ds, vl);
-
-  if (status < 0) {
-    ERROR("write_influxdb_udp plugin: write_influxdb_udp_write failed.");
+  wifxudp_buffer_t *sb = wifxudp_buffer_get();
+  if (sb == NULL)
     return -1;
+
+  bool completed = false;
+
+  /* The point is formatted right into the packet. Only the flush callback
+   * competes for the lock. */
+  pthread_mutex_lock(&sb->lock);
+  int status = write_influxdb_point(sb->packet + sb->fill,
+                                    wifxudp_config_packet_size - sb->fill, ds,
+                                    vl);
+  if ((status < 0) && (sb->fill > 0)) {
+    /* Most likely the point didn't fit. Retry in an empty packet. */
+    wifxudp_buffer_complete(sb);
+    completed = true;
+    status = write_influxdb_point(sb->packet, wifxudp_config_packet_size, ds,
+                                  vl);
   }
-  if (status == 0) /* no real values to send (nan) */
-    return 0;
 
-  pthread_mutex_lock(&send_buffer_lock);
-  if (wifxudp_config_packet_size - send_buffer_fill < status)
-    flush_buffer();
-  memcpy(send_buffer_ptr, buffer, status);
+  if (status > 0) {
+    sb->fill += status;
+    sb->last_update = cdtime();
 
-  send_buffer_fill += status;
-  send_buffer_ptr += status;
-  send_buffer_last_update = cdtime();
+    if (wifxudp_config_packet_size - sb->fill < 120) {
+      /* No room for a new point of average size in buffer,
+         the probability of fail for the new point is bigger than
+         the probability of success */
+      wifxudp_buffer_complete(sb);
+      completed = true;
+    }
+  }
+  pthread_mutex_unlock(&sb->lock);
 
-  if (wifxudp_config_packet_size - send_buffer_fill < 120)
-    /* No room for a new point of average size in buffer,
-       the probability of fail for the new point is bigger than
-       the probability of success */
-    flush_buffer();
+  if (completed)
+    wifxudp_send_queue(/* wait = */ false);
 
-  pthread_mutex_unlock(&send_buffer_lock);
+  if (status < 0) {
+    ERROR("write_influxdb_udp plugin: write_influxdb_udp_write failed.");
+    return -1;
+  }
+  /* status == 0: no real values to send (nan) */
   return 0;
 } /* int write_influxdb_udp_write */
 
@@ -581,11 +769,58 @@ static int write_influxdb_udp_config(oconfig_item_t *ci) {
   return 0;
 } /* int write_influxdb_udp_config */
 
+static int write_influxdb_udp_flush(cdtime_t timeout,
+                                    __attribute__((unused))
+                                    const char *identifier,
+                                    __attribute__((unused))
+                                    user_data_t *user_data) {
+  if (send_queue == NULL)
+    return 0;
+
+  cdtime_t now = cdtime();
+
+  pthread_mutex_lock(&send_buffers_lock);
+  for (wifxudp_buffer_t *sb = send_buffers; sb != NULL; sb = sb->next) {
+    pthread_mutex_lock(&sb->lock);
+    if ((sb->fill > 0) &&
+        ((timeout == 0) || ((sb->last_update + timeout) <= now)))
+      wifxudp_buffer_complete(sb);
+    pthread_mutex_unlock(&sb->lock);
+  }
+  pthread_mutex_unlock(&send_buffers_lock);
+
+  wifxudp_send_queue(/* wait = */ true);
+
+  return 0;
+} /* int write_influxdb_udp_flush */
+
 static int write_influxdb_udp_shutdown(void) {
-  if (send_buffer_fill > 0)
-    flush_buffer();
+  if (send_queue != NULL) {
+    write_influxdb_udp_flush(/* timeout = */ 0, NULL, NULL);
+
+    pthread_mutex_lock(&send_buffers_lock);
+    wifxudp_buffer_t *sb = send_buffers;
+    send_buffers = NULL;
+    pthread_mutex_unlock(&send_buffers_lock);
+
+    while (sb != NULL) {
+      wifxudp_buffer_t *next = sb->next;
+      pthread_mutex_destroy(&sb->lock);
+      sfree(sb->packet);
+      sfree(sb);
+      sb = next;
+    }
 
-  sfree(send_buffer);
+    char *packet;
+    while (c_ring_pop(free_packets, &packet) == 0)
+      free(packet);
+    c_ring_destroy(free_packets);
+    free_packets = NULL;
+    c_ring_destroy(send_queue);
+    send_queue = NULL;
+
+    pthread_key_delete(send_buffer_key);
+  }
 
   if (sending_socket != NULL) {
     sockent_client_disconnect(sending_socket);
@@ -595,6 +830,7 @@ static int write_influxdb_udp_shutdown(void) {
   plugin_unregister_config("write_influxdb_udp");
   plugin_unregister_init("write_influxdb_udp");
   plugin_unregister_write("write_influxdb_udp");
+  plugin_unregister_flush("write_influxdb_udp");
   plugin_unregister_shutdown("write_influxdb_udp");
 
   return 0;
@@ -611,12 +847,24 @@ static int write_influxdb_udp_init(void) {
 
   plugin_register_shutdown("write_influxdb_udp", write_influxdb_udp_shutdown);
 
-  send_buffer = malloc(wifxudp_config_packet_size);
-  if (send_buffer == NULL) {
-    ERROR("write_influxdb_udp plugin: malloc failed.");
+  if (pthread_key_create(&send_buffer_key, /* destructor = */ NULL) != 0) {
+    ERROR("write_influxdb_udp plugin: pthread_key_create failed.");
+    return -1;
+  }
+
+  /* Room for the queued packets plus those being sent. */
+  send_queue = c_ring_create(SEND_QUEUE_SIZE, sizeof(wifxudp_packet_t));
+  free_packets =
+      c_ring_create(SEND_QUEUE_SIZE + SEND_BATCH_MAX, sizeof(char *));
+  if ((send_queue == NULL) || (free_packets == NULL)) {
+    ERROR("write_influxdb_udp plugin: c_ring_create failed.");
+    c_ring_destroy(send_queue);
+    send_queue = NULL;
+    c_ring_destroy(free_packets);
+    free_packets = NULL;
+    pthread_key_delete(send_buffer_key);
     return -1;
   }
-  write_influxdb_udp_init_buffer();
 
   /* setup socket(s) and so on */
   if (sending_socket != NULL) {
@@ -627,28 +875,6 @@ static int write_influxdb_udp_init(void) {
   return 0;
 } /* int write_influxdb_udp_init */
 
-static int write_influxdb_udp_flush(cdtime_t timeout,
-                                    __attribute__((unused))
-                                    const char *identifier,
-                                    __attribute__((unused))
-                                    user_data_t *user_data) {
-  pthread_mutex_lock(&send_buffer_lock);
-
-  if (send_buffer_fill > 0) {
-    if (timeout > 0) {
-      cdtime_t now = cdtime();
-      if ((send_buffer_last_update + timeout) > now) {
-        pthread_mutex_unlock(&send_buffer_lock);
-        return 0;
-      }
-    }
-    flush_buffer();
-  }
-  pthread_mutex_unlock(&send_buffer_lock);
-
-  return 0;
-} /* int write_influxdb_udp_flush */
-
 void module_register(void) {
   plugin_register_complex_config("write_influxdb_udp",
                                  write_influxdb_udp_config);
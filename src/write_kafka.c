@@ -53,11 +53,34 @@ struct kafka_topic_context {
   char *postfix;
   char escape_char;
   char *topic_name;
+  /* Use the value list's identifier as key, see kafka_message_partition(). */
+  bool key_identifier;
+  /* Number of value lists packed into one message. */
+  size_t values_per_message;
+  size_t max_message_size;
+  /* Cached number of partitions of the topic, see kafka_partition_count(). */
+  int32_t partition_cnt;
+  cdtime_t partition_cnt_update;
   pthread_mutex_t lock;
 };
 
+/* Upper bound for one formatted value list; same as the old stack buffer. */
+#define KAFKA_VALUE_MAX 8192
+#define KAFKA_MAX_MESSAGE_SIZE_DEFAULT 524288
+#define KAFKA_METADATA_INTERVAL TIME_T_TO_CDTIME_T(60)
+
+/* A message being assembled. The buffer is handed to librdkafka with
+ * RD_KAFKA_MSG_F_FREE, which frees it once the message has been delivered. */
+typedef struct {
+  char *data;
+  size_t size;
+  size_t fill;
+  size_t count;
+} kafka_message_t;
+
 static int kafka_handle(struct kafka_topic_context *);
-static int kafka_write(const data_set_t *, const value_list_t *, user_data_t *);
+static int kafka_write_batch(write_batch_entry_t const *, size_t,
+                             user_data_t *);
 static int32_t kafka_partition(const rd_kafka_topic_t *, const void *, size_t,
                                int32_t, void *, void *);
 
@@ -170,69 +193,296 @@ static int kafka_handle(struct kafka_topic_context *ctx) /* {{{ */
 
 } /* }}} int kafka_handle */
 
-static int kafka_write(const data_set_t *ds, /* {{{ */
-                       const value_list_t *vl, user_data_t *ud) {
-  int status = 0;
-  void *key;
-  size_t keylen = 0;
-  char buffer[8192];
-  size_t bfree = sizeof(buffer);
-  size_t bfill = 0;
-  size_t blen = 0;
-  struct kafka_topic_context *ctx = ud->data;
+/* Makes sure at least "need" bytes are available after the fill pointer. */
+static int kafka_message_reserve(kafka_message_t *m, size_t need) /* {{{ */
+{
+  if (m->size - m->fill >= need)
+    return 0;
 
-  if ((ds == NULL) || (vl == NULL) || (ctx == NULL))
-    return EINVAL;
+  size_t size = (m->size == 0) ? need : m->size;
+  while (size - m->fill < need)
+    size *= 2;
 
-  pthread_mutex_lock(&ctx->lock);
-  status = kafka_handle(ctx);
-  pthread_mutex_unlock(&ctx->lock);
-  if (status != 0)
-    return status;
+  char *tmp = realloc(m->data, size);
+  if (tmp == NULL)
+    return ENOMEM;
 
-  bzero(buffer, sizeof(buffer));
+  m->data = tmp;
+  m->size = size;
+  return 0;
+} /* }}} int kafka_message_reserve */
+
+/* Appends one value list to the message, formatting it in place. */
+static int kafka_message_add(struct kafka_topic_context *ctx, /* {{{ */
+                             kafka_message_t *m, const data_set_t *ds,
+                             const value_list_t *vl) {
+  /* Room for the value list plus separator and terminator. */
+  if (kafka_message_reserve(m, KAFKA_VALUE_MAX + 2) != 0)
+    return ENOMEM;
+
+  char *buffer = m->data + m->fill;
+  size_t bfree = KAFKA_VALUE_MAX;
+  int status;
 
   switch (ctx->format) {
   case KAFKA_FORMAT_COMMAND:
-    status = cmd_create_putval(buffer, sizeof(buffer), ds, vl);
+    /* Newline-delimited PUTVAL commands. */
+    if (m->count > 0) {
+      *buffer = '\n';
+      buffer++;
+    }
+    status = cmd_create_putval(buffer, bfree, ds, vl);
     if (status != 0) {
       ERROR("write_kafka plugin: cmd_create_putval failed with status %i.",
             status);
       return status;
     }
-    blen = strlen(buffer);
+    m->fill = (size_t)(buffer - m->data) + strlen(buffer);
     break;
-  case KAFKA_FORMAT_JSON:
-    format_json_initialize(buffer, &bfill, &bfree);
-    format_json_value_list(buffer, &bfill, &bfree, ds, vl, ctx->store_rates);
-    format_json_finalize(buffer, &bfill, &bfree);
-    blen = strlen(buffer);
+  case KAFKA_FORMAT_JSON: {
+    /* format_json_value_list() prepends a comma, which
+     * format_json_finalize() replaces with the opening bracket of the
+     * array. */
+    size_t bfill = m->fill;
+    status = format_json_value_list(m->data, &bfill, &bfree, ds, vl,
+                                    ctx->store_rates);
+    if (status != 0) {
+      ERROR("write_kafka plugin: format_json_value_list failed with "
+            "status %i.",
+            status);
+      return status;
+    }
+    m->fill = bfill;
     break;
+  }
   case KAFKA_FORMAT_GRAPHITE:
-    status =
-        format_graphite(buffer, sizeof(buffer), ds, vl, ctx->prefix,
-                        ctx->postfix, ctx->escape_char, ctx->graphite_flags);
+    /* Graphite lines are terminated already. */
+    *buffer = 0;
+    status = format_graphite(buffer, bfree, ds, vl, ctx->prefix, ctx->postfix,
+                             ctx->escape_char, ctx->graphite_flags);
     if (status != 0) {
       ERROR("write_kafka plugin: format_graphite failed with status %i.",
             status);
       return status;
     }
-    blen = strlen(buffer);
+    m->fill += strlen(buffer);
     break;
   default:
     ERROR("write_kafka plugin: invalid format %i.", ctx->format);
     return -1;
   }
 
-  key =
-      (ctx->key != NULL) ? ctx->key : kafka_random_key(KAFKA_RANDOM_KEY_BUFFER);
-  keylen = strlen(key);
+  m->count++;
+  return 0;
+} /* }}} int kafka_message_add */
+
+/* Hands the message to librdkafka. The buffer is owned by librdkafka
+ * afterwards, or freed here if producing fails. */
+static int kafka_message_produce(struct kafka_topic_context *ctx, /* {{{ */
+                                 kafka_message_t *m, int32_t partition,
+                                 const char *key) {
+  size_t keylen;
+  int status = 0;
+
+  if (m->count == 0)
+    return 0;
+
+  if (ctx->format == KAFKA_FORMAT_JSON) {
+    size_t bfree = m->size - m->fill;
+    format_json_finalize(m->data, &m->fill, &bfree);
+  }
+
+  /* Don't keep mostly empty buffers queued in librdkafka. */
+  if (m->size > 2 * m->fill + 64) {
+    char *tmp = realloc(m->data, m->fill + 1);
+    if (tmp != NULL) {
+      m->data = tmp;
+      m->size = m->fill + 1;
+    }
+  }
+
+  if (key == NULL && !ctx->key_identifier)
+    key = (ctx->key != NULL) ? ctx->key
+                             : kafka_random_key(KAFKA_RANDOM_KEY_BUFFER);
+  keylen = (key != NULL) ? strlen(key) : 0;
+
+  if (rd_kafka_produce(ctx->topic, partition, RD_KAFKA_MSG_F_FREE, m->data,
+                       m->fill, key, keylen, NULL) != 0) {
+    ERROR("write_kafka plugin: Producing a message with %" PRIsz
+          " value list(s) failed: %s",
+          m->count, rd_kafka_err2str(kafka_error()));
+    sfree(m->data);
+    status = -1;
+  }
+
+  m->data = NULL;
+  m->size = 0;
+  m->fill = 0;
+  m->count = 0;
+
+  return status;
+} /* }}} int kafka_message_produce */
+
+/* Returns the number of partitions of the topic. The result is cached and
+ * refreshed every KAFKA_METADATA_INTERVAL. Returns zero if unknown. */
+static int32_t kafka_partition_count(struct kafka_topic_context *ctx) /* {{{ */
+{
+  const struct rd_kafka_metadata *md = NULL;
+  cdtime_t now = cdtime();
+  int32_t cnt;
+
+  pthread_mutex_lock(&ctx->lock);
+  if (ctx->partition_cnt > 0 &&
+      (now - ctx->partition_cnt_update) < KAFKA_METADATA_INTERVAL) {
+    cnt = ctx->partition_cnt;
+    pthread_mutex_unlock(&ctx->lock);
+    return cnt;
+  }
+
+  if (rd_kafka_metadata(ctx->kafka, /* all_topics = */ 0, ctx->topic, &md,
+                        /* timeout_ms = */ 1000) ==
+      RD_KAFKA_RESP_ERR_NO_ERROR) {
+    if (md->topic_cnt == 1 && md->topics[0].err == RD_KAFKA_RESP_ERR_NO_ERROR &&
+        md->topics[0].partition_cnt > 0) {
+      ctx->partition_cnt = md->topics[0].partition_cnt;
+      ctx->partition_cnt_update = now;
+    }
+    rd_kafka_metadata_destroy(md);
+  } else if (ctx->partition_cnt == 0) {
+    WARNING("write_kafka plugin: Unable to determine the number of "
+            "partitions of topic \"%s\".",
+            ctx->topic_name);
+  }
+
+  cnt = ctx->partition_cnt;
+  pthread_mutex_unlock(&ctx->lock);
+  return cnt;
+} /* }}} int32_t kafka_partition_count */
+
+/* One message per value list. With "Key Identifier" the identifier is used as
+ * the message key, so kafka_partition() places each series on a fixed
+ * partition. */
+static int kafka_write_single(struct kafka_topic_context *ctx, /* {{{ */
+                              write_batch_entry_t const *entries,
+                              size_t entries_num) {
+  int status = 0;
+
+  for (size_t i = 0; i < entries_num; i++) {
+    kafka_message_t m = {0};
+    char ident[6 * DATA_MAX_NAME_LEN];
+    int tmp;
+
+    tmp = kafka_message_add(ctx, &m, entries[i].ds, entries[i].vl);
+    if (tmp == 0 && ctx->key_identifier)
+      tmp = FORMAT_VL(ident, sizeof(ident), entries[i].vl);
+    if (tmp != 0) {
+      sfree(m.data);
+      status = tmp;
+      continue;
+    }
 
-  rd_kafka_produce(ctx->topic, RD_KAFKA_PARTITION_UA, RD_KAFKA_MSG_F_COPY,
-                   buffer, blen, key, keylen, NULL);
+    tmp = kafka_message_produce(ctx, &m, RD_KAFKA_PARTITION_UA,
+                                ctx->key_identifier ? ident : NULL);
+    if (tmp != 0)
+      status = tmp;
+  }
 
   return status;
-} /* }}} int kafka_write */
+} /* }}} int kafka_write_single */
+
+/* Packs up to "values_per_message" value lists into each message. With
+ * "Key Identifier" value lists are grouped by the partition kafka_partition()
+ * would pick for their identifier and sent to that partition explicitly, so
+ * that the order of each series is preserved. */
+static int kafka_write_packed(struct kafka_topic_context *ctx, /* {{{ */
+                              write_batch_entry_t const *entries,
+                              size_t entries_num) {
+  kafka_message_t *messages;
+  size_t messages_num = 1;
+  int status = 0;
+
+  if (ctx->key_identifier) {
+    int32_t cnt = kafka_partition_count(ctx);
+    if (cnt > 0)
+      messages_num = (size_t)cnt;
+  }
+
+  messages = calloc(messages_num, sizeof(*messages));
+  if (messages == NULL)
+    return ENOMEM;
+
+  for (size_t i = 0; i < entries_num; i++) {
+    size_t idx = 0;
+    int tmp;
+
+    if (messages_num > 1) {
+      char ident[6 * DATA_MAX_NAME_LEN];
+
+      if (FORMAT_VL(ident, sizeof(ident), entries[i].vl) != 0)
+        continue;
+      idx = kafka_hash(ident, strlen(ident)) % messages_num;
+    }
+
+    kafka_message_t *m = messages + idx;
+    int32_t partition =
+        (messages_num > 1) ? (int32_t)idx : RD_KAFKA_PARTITION_UA;
+
+    if (m->count > 0 && m->fill + KAFKA_VALUE_MAX > ctx->max_message_size) {
+      tmp = kafka_message_produce(ctx, m, partition, NULL);
+      if (tmp != 0)
+        status = tmp;
+    }
+
+    tmp = kafka_message_add(ctx, m, entries[i].ds, entries[i].vl);
+    if (tmp != 0) {
+      status = tmp;
+      continue;
+    }
+
+    if (m->count >= ctx->values_per_message) {
+      tmp = kafka_message_produce(ctx, m, partition, NULL);
+      if (tmp != 0)
+        status = tmp;
+    }
+  }
+
+  for (size_t i = 0; i < messages_num; i++) {
+    int32_t partition =
+        (messages_num > 1) ? (int32_t)i : RD_KAFKA_PARTITION_UA;
+    int tmp = kafka_message_produce(ctx, messages + i, partition, NULL);
+    if (tmp != 0)
+      status = tmp;
+    sfree(messages[i].data);
+  }
+  sfree(messages);
+
+  return status;
+} /* }}} int kafka_write_packed */
+
+static int kafka_write_batch(write_batch_entry_t const *entries, /* {{{ */
+                             size_t entries_num, user_data_t *ud) {
+  struct kafka_topic_context *ctx = ud->data;
+  int status;
+
+  if (ctx == NULL)
+    return EINVAL;
+
+  pthread_mutex_lock(&ctx->lock);
+  status = kafka_handle(ctx);
+  pthread_mutex_unlock(&ctx->lock);
+  if (status != 0)
+    return status;
+
+  if (ctx->values_per_message > 1)
+    status = kafka_write_packed(ctx, entries, entries_num);
+  else
+    status = kafka_write_single(ctx, entries, entries_num);
+
+  /* Serve delivery reports and errors. */
+  rd_kafka_poll(ctx->kafka, 0);
+
+  return status;
+} /* }}} int kafka_write_batch */
 
 static void kafka_topic_context_free(void *p) /* {{{ */
 {
@@ -276,6 +526,8 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
   tctx->store_rates = true;
   tctx->format = KAFKA_FORMAT_JSON;
   tctx->key = NULL;
+  tctx->values_per_message = 1;
+  tctx->max_message_size = KAFKA_MAX_MESSAGE_SIZE_DEFAULT;
 
   if ((tctx->kafka_conf = rd_kafka_conf_dup(conf)) == NULL) {
     sfree(tctx);
@@ -343,7 +595,27 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
       if (strcasecmp("Random", tctx->key) == 0) {
         sfree(tctx->key);
         tctx->key = strdup(kafka_random_key(KAFKA_RANDOM_KEY_BUFFER));
+      } else if (strcasecmp("Identifier", tctx->key) == 0) {
+        sfree(tctx->key);
+        tctx->key_identifier = true;
       }
+    } else if (strcasecmp("ValuesPerMessage", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if (status == 0 && tmp < 1) {
+        WARNING("write_kafka plugin: ValuesPerMessage must be at least 1.");
+        status = -1;
+      } else if (status == 0)
+        tctx->values_per_message = (size_t)tmp;
+    } else if (strcasecmp("MaxMessageSize", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if (status == 0 && tmp < 2 * KAFKA_VALUE_MAX) {
+        WARNING("write_kafka plugin: MaxMessageSize must be at least %d.",
+                2 * KAFKA_VALUE_MAX);
+        status = -1;
+      } else if (status == 0)
+        tctx->max_message_size = (size_t)tmp;
     } else if (strcasecmp("Format", child->key) == 0) {
       status = cf_util_get_string(child, &key);
       if (status != 0)
@@ -413,13 +685,18 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
   ssnprintf(callback_name, sizeof(callback_name), "write_kafka/%s",
             tctx->topic_name);
 
-  status = plugin_register_write(callback_name, kafka_write,
-                                 &(user_data_t){
-                                     .data = tctx,
-                                     .free_func = kafka_topic_context_free,
-                                 });
+  /* Make sure the batches handed to us are large enough to fill a message. */
+  status = plugin_register_write_batch(
+      callback_name, kafka_write_batch,
+      /* batch_size = */
+      (tctx->values_per_message > 1) ? tctx->values_per_message : 0,
+      /* max_age = */ 0,
+      &(user_data_t){
+          .data = tctx,
+          .free_func = kafka_topic_context_free,
+      });
   if (status != 0) {
-    WARNING("write_kafka plugin: plugin_register_write (\"%s\") "
+    WARNING("write_kafka plugin: plugin_register_write_batch (\"%s\") "
             "failed with status %i.",
             callback_name, status);
     goto errout;
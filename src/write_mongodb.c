@@ -33,6 +33,7 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 #include "utils_cache.h"
 
@@ -53,12 +54,31 @@ struct wm_node_s {
   bool store_rates;
   bool connected;
 
+  /* Bulk writes */
+  int bulk_size;
+  cdtime_t bulk_timeout;
+  int write_concern_w;
+  int write_concern_timeout;
+  bool journal;
+  bson_t *bulk_opts;
+
   mongoc_client_t *client;
   mongoc_database_t *database;
+  /* Maps a collection name to its wm_batch_t. */
+  c_avl_tree_t *batches;
   pthread_mutex_t lock;
 };
 typedef struct wm_node_s wm_node_t;
 
+/* Documents queued for one collection. */
+struct wm_batch_s {
+  mongoc_collection_t *collection;
+  mongoc_bulk_operation_t *bulk;
+  int count;
+  cdtime_t start;
+};
+typedef struct wm_batch_s wm_batch_t;
+
 /*
  * Functions
  */
@@ -66,7 +86,8 @@ static bson_t *wm_create_bson(const data_set_t *ds, /* {{{ */
                               const value_list_t *vl, bool store_rates) {
   bson_t *ret;
   bson_t subarray;
-  gauge_t *rates;
+  gauge_t const *rates = NULL;
+  gauge_t *rates_alloc = NULL;
 
   ret = bson_new();
   if (!ret) {
@@ -75,14 +96,12 @@ static bson_t *wm_create_bson(const data_set_t *ds, /* {{{ */
   }
 
   if (store_rates) {
-    rates = uc_get_rate(ds, vl);
+    rates = uc_get_rate_attached(ds, vl, &rates_alloc);
     if (rates == NULL) {
       ERROR("write_mongodb plugin: uc_get_rate() failed.");
       bson_destroy(ret);
       return NULL;
     }
-  } else {
-    rates = NULL;
   }
 
   BSON_APPEND_DATE_TIME(ret, "timestamp", CDTIME_T_TO_MS(vl->time));
@@ -139,7 +158,7 @@ static bson_t *wm_create_bson(const data_set_t *ds, /* {{{ */
   }
   bson_append_array_end(ret, &subarray); /* }}} dsnames */
 
-  sfree(rates);
+  sfree(rates_alloc);
 
   size_t error_location;
   if (!bson_validate(ret, BSON_VALIDATE_UTF8, &error_location)) {
@@ -218,10 +237,139 @@ static int wm_initialize(wm_node_t *node) /* {{{ */
   return 0;
 } /* }}} int wm_initialize */
 
+static void wm_batch_destroy(wm_batch_t *b) /* {{{ */
+{
+  if (b == NULL)
+    return;
+
+  if (b->bulk != NULL)
+    mongoc_bulk_operation_destroy(b->bulk);
+  if (b->collection != NULL)
+    mongoc_collection_destroy(b->collection);
+  sfree(b);
+} /* }}} void wm_batch_destroy */
+
+/* Drops all queued documents and closes the connection. Collections have to
+ * be destroyed before the client they were created from. */
+static void wm_disconnect(wm_node_t *node) /* {{{ */
+{
+  void *key;
+  void *value;
+
+  if (node->batches != NULL) {
+    while (c_avl_pick(node->batches, &key, &value) == 0) {
+      wm_batch_t *b = value;
+
+      if (b->count > 0)
+        WARNING("write_mongodb plugin: node %s: Dropping %d queued "
+                "document(s) for collection \"%s\".",
+                node->name, b->count, (char *)key);
+      sfree(key);
+      wm_batch_destroy(b);
+    }
+  }
+
+  if (node->database != NULL)
+    mongoc_database_destroy(node->database);
+  if (node->client != NULL)
+    mongoc_client_destroy(node->client);
+  node->database = NULL;
+  node->client = NULL;
+  node->connected = false;
+} /* }}} void wm_disconnect */
+
+static wm_batch_t *wm_batch_get(wm_node_t *node, /* {{{ */
+                                char const *name) {
+  wm_batch_t *b = NULL;
+
+  if (c_avl_get(node->batches, name, (void *)&b) == 0)
+    return b;
+
+  b = calloc(1, sizeof(*b));
+  if (b == NULL)
+    return NULL;
+
+  b->collection = mongoc_client_get_collection(node->client, "collectd", name);
+  if (b->collection == NULL) {
+    ERROR("write_mongodb plugin: error creating/getting collection");
+    sfree(b);
+    return NULL;
+  }
+
+  char *key = strdup(name);
+  if (key == NULL || c_avl_insert(node->batches, key, b) != 0) {
+    sfree(key);
+    wm_batch_destroy(b);
+    return NULL;
+  }
+
+  return b;
+} /* }}} wm_batch_t *wm_batch_get */
+
+/* Sends all documents queued in "b" as one unordered bulk insert. */
+static int wm_batch_execute(wm_node_t *node, wm_batch_t *b) /* {{{ */
+{
+  bson_t reply;
+  bson_error_t error;
+  uint32_t status;
+
+  if (b->count == 0)
+    return 0;
+
+  status = mongoc_bulk_operation_execute(b->bulk, &reply, &error);
+  bson_destroy(&reply);
+
+  if (status == 0)
+    ERROR("write_mongodb plugin: node %s: error inserting %d record(s): %s",
+          node->name, b->count, error.message);
+
+  /* A bulk operation can only be executed once. */
+  mongoc_bulk_operation_destroy(b->bulk);
+  b->bulk = NULL;
+  b->count = 0;
+
+  return (status == 0) ? -1 : 0;
+} /* }}} int wm_batch_execute */
+
+/* Executes all batches older than "timeout". Must be called with the node's
+ * lock held. */
+static int wm_flush_nolock(wm_node_t *node, cdtime_t timeout) /* {{{ */
+{
+  c_avl_iterator_t *iter;
+  wm_batch_t *b;
+  void *key;
+  cdtime_t now = cdtime();
+  int status = 0;
+
+  if (node->batches == NULL)
+    return 0;
+
+  iter = c_avl_get_iterator(node->batches);
+  if (iter == NULL)
+    return -1;
+
+  while (c_avl_iterator_next(iter, &key, (void *)&b) == 0) {
+    if (b->count == 0)
+      continue;
+    if (timeout != 0 && (now - b->start) < timeout)
+      continue;
+
+    status = wm_batch_execute(node, b);
+    if (status != 0)
+      break;
+  }
+  c_avl_iterator_destroy(iter);
+
+  if (status != 0)
+    wm_disconnect(node);
+
+  return status;
+} /* }}} int wm_flush_nolock */
+
 static int wm_write(const data_set_t *ds, /* {{{ */
                     const value_list_t *vl, user_data_t *ud) {
   wm_node_t *node = ud->data;
-  mongoc_collection_t *collection = NULL;
+  wm_batch_t *b;
   bson_t *bson_record;
   bson_error_t error;
   int status;
@@ -240,46 +388,57 @@ static int wm_write(const data_set_t *ds, /* {{{ */
     return -1;
   }
 
-  collection =
-      mongoc_client_get_collection(node->client, "collectd", vl->plugin);
-  if (!collection) {
-    ERROR("write_mongodb plugin: error creating/getting collection");
-    mongoc_database_destroy(node->database);
-    mongoc_client_destroy(node->client);
-    node->database = NULL;
-    node->client = NULL;
-    node->connected = false;
+  b = wm_batch_get(node, vl->plugin);
+  if (b == NULL) {
+    wm_disconnect(node);
     pthread_mutex_unlock(&node->lock);
     bson_destroy(bson_record);
     return -1;
   }
 
-  status = mongoc_collection_insert(collection, MONGOC_INSERT_NONE, bson_record,
-                                    NULL, &error);
+  if (b->bulk == NULL) {
+    b->bulk = mongoc_collection_create_bulk_operation_with_opts(
+        b->collection, node->bulk_opts);
+    b->start = cdtime();
+  }
 
-  if (!status) {
-    ERROR("write_mongodb plugin: error inserting record: %s", error.message);
-    mongoc_database_destroy(node->database);
-    mongoc_client_destroy(node->client);
-    node->database = NULL;
-    node->client = NULL;
-    node->connected = false;
+  /* The document is copied into the bulk operation. */
+  if (!mongoc_bulk_operation_insert_with_opts(b->bulk, bson_record, NULL,
+                                              &error)) {
+    ERROR("write_mongodb plugin: error queueing record: %s", error.message);
     pthread_mutex_unlock(&node->lock);
     bson_destroy(bson_record);
-    mongoc_collection_destroy(collection);
     return -1;
   }
+  b->count++;
+  bson_destroy(bson_record);
 
-  /* free our resource as not to leak memory */
-  mongoc_collection_destroy(collection);
+  status = 0;
+  if (b->count >= node->bulk_size ||
+      (cdtime() - b->start) >= node->bulk_timeout) {
+    status = wm_batch_execute(node, b);
+    if (status != 0)
+      wm_disconnect(node);
+  }
 
   pthread_mutex_unlock(&node->lock);
 
-  bson_destroy(bson_record);
-
-  return 0;
+  return status;
 } /* }}} int wm_write */
 
+static int wm_flush(cdtime_t timeout, /* {{{ */
+                    __attribute__((unused)) const char *identifier,
+                    user_data_t *ud) {
+  wm_node_t *node = ud->data;
+  int status;
+
+  pthread_mutex_lock(&node->lock);
+  status = wm_flush_nolock(node, timeout);
+  pthread_mutex_unlock(&node->lock);
+
+  return status;
+} /* }}} int wm_flush */
+
 static void wm_config_free(void *ptr) /* {{{ */
 {
   wm_node_t *node = ptr;
@@ -287,16 +446,82 @@ static void wm_config_free(void *ptr) /* {{{ */
   if (node == NULL)
     return;
 
-  mongoc_database_destroy(node->database);
-  mongoc_client_destroy(node->client);
-  node->database = NULL;
-  node->client = NULL;
-  node->connected = false;
+  if (node->connected)
+    wm_flush_nolock(node, 0);
+  wm_disconnect(node);
+
+  if (node->batches != NULL)
+    c_avl_destroy(node->batches);
+  if (node->bulk_opts != NULL)
+    bson_destroy(node->bulk_opts);
 
+  pthread_mutex_destroy(&node->lock);
   sfree(node->host);
+  sfree(node->db);
+  sfree(node->user);
+  sfree(node->passwd);
   sfree(node);
 } /* }}} void wm_config_free */
 
+/* Options passed to every bulk operation: unordered, so that one bad document
+ * doesn't stop the remaining ones from being inserted, and the configured
+ * write concern. */
+static int wm_create_bulk_opts(wm_node_t *node) /* {{{ */
+{
+  mongoc_write_concern_t *wc;
+  bool ok;
+
+  node->bulk_opts = bson_new();
+  if (node->bulk_opts == NULL)
+    return ENOMEM;
+
+  BSON_APPEND_BOOL(node->bulk_opts, "ordered", false);
+
+  if (node->write_concern_w == MONGOC_WRITE_CONCERN_W_DEFAULT &&
+      node->write_concern_timeout == 0 && !node->journal)
+    return 0;
+
+  wc = mongoc_write_concern_new();
+  if (wc == NULL)
+    return ENOMEM;
+
+  mongoc_write_concern_set_w(wc, node->write_concern_w);
+  if (node->write_concern_timeout > 0)
+    mongoc_write_concern_set_wtimeout_int64(wc, node->write_concern_timeout);
+  if (node->journal)
+    mongoc_write_concern_set_journal(wc, true);
+
+  ok = mongoc_write_concern_append(wc, node->bulk_opts);
+  mongoc_write_concern_destroy(wc);
+
+  if (!ok) {
+    ERROR("write_mongodb plugin: node %s: Invalid write concern.", node->name);
+    return EINVAL;
+  }
+
+  return 0;
+} /* }}} int wm_create_bulk_opts */
+
+static int wm_config_write_concern(oconfig_item_t *ci, int *ret) /* {{{ */
+{
+  if (ci->values_num == 1 && ci->values[0].type == OCONFIG_TYPE_STRING &&
+      strcasecmp("majority", ci->values[0].value.string) == 0) {
+    *ret = MONGOC_WRITE_CONCERN_W_MAJORITY;
+    return 0;
+  }
+
+  if (ci->values_num == 1 && ci->values[0].type == OCONFIG_TYPE_NUMBER &&
+      ci->values[0].value.number >= 0) {
+    *ret = (int)ci->values[0].value.number;
+    return 0;
+  }
+
+  ERROR("write_mongodb plugin: The \"%s\" option requires a non-negative "
+        "number or \"majority\".",
+        ci->key);
+  return -1;
+} /* }}} int wm_config_write_concern */
+
 static int wm_config_node(oconfig_item_t *ci) /* {{{ */
 {
   wm_node_t *node;
@@ -313,13 +538,21 @@ static int wm_config_node(oconfig_item_t *ci) /* {{{ */
   }
   node->port = MONGOC_DEFAULT_PORT;
   node->store_rates = true;
+  node->bulk_size = 1;
+  node->bulk_timeout = TIME_T_TO_CDTIME_T(1);
+  node->write_concern_w = MONGOC_WRITE_CONCERN_W_DEFAULT;
   pthread_mutex_init(&node->lock, /* attr = */ NULL);
 
+  node->batches = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (node->batches == NULL) {
+    wm_config_free(node);
+    return ENOMEM;
+  }
+
   status = cf_util_get_string_buffer(ci, node->name, sizeof(node->name));
 
   if (status != 0) {
-    sfree(node->host);
-    sfree(node);
+    wm_config_free(node);
     return status;
   }
 
@@ -344,6 +577,21 @@ static int wm_config_node(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_string(child, &node->user);
     else if (strcasecmp("Password", child->key) == 0)
       status = cf_util_get_string(child, &node->passwd);
+    else if (strcasecmp("BulkSize", child->key) == 0) {
+      status = cf_util_get_int(child, &node->bulk_size);
+      if (status == 0 && node->bulk_size < 1) {
+        ERROR("write_mongodb plugin: node %s: BulkSize must be at least 1.",
+              node->name);
+        status = -1;
+      }
+    } else if (strcasecmp("BulkTimeout", child->key) == 0)
+      status = cf_util_get_cdtime(child, &node->bulk_timeout);
+    else if (strcasecmp("WriteConcern", child->key) == 0)
+      status = wm_config_write_concern(child, &node->write_concern_w);
+    else if (strcasecmp("WriteConcernTimeout", child->key) == 0)
+      status = cf_util_get_int(child, &node->write_concern_timeout);
+    else if (strcasecmp("Journal", child->key) == 0)
+      status = cf_util_get_boolean(child, &node->journal);
     else
       WARNING("write_mongodb plugin: Ignoring unknown config option \"%s\".",
               child->key);
@@ -365,6 +613,9 @@ static int wm_config_node(oconfig_item_t *ci) /* {{{ */
     }
   }
 
+  if (status == 0)
+    status = wm_create_bulk_opts(node);
+
   if (status == 0) {
     char cb_name[sizeof("write_mongodb/") + DATA_MAX_NAME_LEN];
 
@@ -377,6 +628,11 @@ static int wm_config_node(oconfig_item_t *ci) /* {{{ */
                                    });
     INFO("write_mongodb plugin: registered write plugin %s %d", cb_name,
          status);
+    if (status == 0)
+      plugin_register_flush(cb_name, wm_flush,
+                            &(user_data_t){
+                                .data = node,
+                            });
   }
 
   if (status != 0)
@@ -36,6 +36,10 @@
 
 #include <microhttpd.h>
 
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 #include <netdb.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -46,6 +50,17 @@
 
 #define VARINT_UINT32_BYTES 5
 
+/* Size of the buffer libmicrohttpd fills from stream_read(). */
+#ifndef PROMETHEUS_STREAM_BLOCK_SIZE
+#define PROMETHEUS_STREAM_BLOCK_SIZE 65536
+#endif
+
+/* Streaming responses needs callback based responses that can signal their
+ * end, i.e. libmicrohttpd 0.9.x. */
+#if defined(MHD_CONTENT_READER_END_OF_STREAM) && defined(MHD_SIZE_UNKNOWN)
+#define HAVE_PROM_STREAM 1
+#endif
+
 #define CONTENT_TYPE_PROTO                                                     \
   "application/vnd.google.protobuf; proto=io.prometheus.client.MetricFamily; " \
   "encoding=delimited"
@@ -57,14 +72,132 @@
 #define MHD_RESULT int
 #endif
 
-static c_avl_tree_t *metrics;
-static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+#ifndef PROMETHEUS_METRICS_SHARDS
+#define PROMETHEUS_METRICS_SHARDS 16
+#endif
+
+/* Metric families are spread over several trees by the hash of their name, so
+ * that writers updating different families don't contend for one lock. */
+typedef struct {
+  pthread_mutex_t lock;
+  c_avl_tree_t *families;
+} metrics_shard_t;
+
+static metrics_shard_t metrics[PROMETHEUS_METRICS_SHARDS];
 
 static char *httpd_host = NULL;
 static unsigned short httpd_port = 9103;
 static struct MHD_Daemon *httpd;
 
 static cdtime_t staleness_delta = PROMETHEUS_DEFAULT_STALENESS_DELTA;
+#if HAVE_PROM_STREAM
+static bool stream_responses;
+#endif
+
+/* The formats a scrape can ask for. */
+enum { FORMAT_TEXT = 0, FORMAT_PROTOBUF, FORMAT_NUM };
+
+/* prom_blob_t is an immutable, reference counted piece of rendered output. It
+ * is shared between the metrics trees and the scrapes in progress, so that
+ * responses can be assembled without holding a shard's lock. */
+typedef struct {
+  size_t refs;
+  size_t len;
+  uint8_t data[];
+} prom_blob_t;
+
+/* prom_family_t adds the rendered fragments and a hash index to a metric
+ * family. The metrics trees store pointers to "fam", which therefore must be
+ * the first member. A fragment is NULL until the next scrape after one of the
+ * metrics changed. "index" is an open addressing hash table of the metrics'
+ * label sets, holding positions in "fam.metric" plus one, zero marking an
+ * empty slot. */
+typedef struct {
+  Io__Prometheus__Client__MetricFamily fam;
+  prom_blob_t *fragment[FORMAT_NUM];
+
+  size_t metric_size;
+  size_t *index;
+  size_t index_size;
+} prom_family_t;
+
+/* metrics_generation is incremented atomically whenever a metric changes.
+ * Responses are cached, plain and gzip compressed, until it does. The cache is
+ * protected by "response_lock". */
+static uint64_t metrics_generation;
+static pthread_mutex_t response_lock = PTHREAD_MUTEX_INITIALIZER;
+static prom_blob_t *response_cache[FORMAT_NUM][2];
+static uint64_t response_generation[FORMAT_NUM][2];
+
+/* metrics_shard returns the shard holding the metric family called name. */
+static metrics_shard_t *metrics_shard(char const *name) {
+  return &metrics[hash_name(name) % PROMETHEUS_METRICS_SHARDS];
+}
+
+static prom_blob_t *blob_create(size_t len) {
+  prom_blob_t *b = malloc(sizeof(*b) + len);
+  if (b == NULL)
+    return NULL;
+
+  b->refs = 1;
+  b->len = len;
+  return b;
+}
+
+static prom_blob_t *blob_ref(prom_blob_t *b) {
+  __atomic_fetch_add(&b->refs, 1, __ATOMIC_RELAXED);
+  return b;
+}
+
+static void blob_unref(prom_blob_t *b) {
+  if (b == NULL)
+    return;
+
+  if (__atomic_sub_fetch(&b->refs, 1, __ATOMIC_ACQ_REL) == 0)
+    free(b);
+}
+
+#if HAVE_ZLIB
+/* blob_gzip returns a gzip compressed copy of in. */
+static prom_blob_t *blob_gzip(prom_blob_t const *in) {
+  z_stream s = {0};
+  /* 15 + 16: the largest window, with a gzip header and trailer. */
+  if (deflateInit2(&s, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK)
+    return NULL;
+
+  prom_blob_t *out = blob_create(deflateBound(&s, (uLong)in->len));
+  if (out != NULL) {
+    s.next_in = (Bytef *)in->data;
+    s.avail_in = (uInt)in->len;
+    s.next_out = out->data;
+    s.avail_out = (uInt)out->len;
+
+    if (deflate(&s, Z_FINISH) == Z_STREAM_END) {
+      out->len = (size_t)s.total_out;
+    } else {
+      blob_unref(out);
+      out = NULL;
+    }
+  }
+
+  deflateEnd(&s);
+  return out;
+}
+#endif
+
+/* metric_family_invalidate drops the rendered fragments of fam after one of its
+ * metrics changed. Must be called with the shard's lock held. */
+static void
+metric_family_invalidate(Io__Prometheus__Client__MetricFamily *fam) {
+  prom_family_t *pf = (prom_family_t *)fam;
+
+  for (size_t i = 0; i < FORMAT_NUM; i++) {
+    blob_unref(pf->fragment[i]);
+    pf->fragment[i] = NULL;
+  }
+  __atomic_fetch_add(&metrics_generation, 1, __ATOMIC_RELEASE);
+}
 
 /* Unfortunately, protoc-c doesn't export its implementation of varint, so we
  * need to implement our own. */
@@ -83,30 +216,21 @@ static size_t varint(uint8_t buffer[static VARINT_UINT32_BYTES],
   return 0;
 }
 
-/* format_protobuf iterates over all metric families in "metrics" and adds them
- * to a buffer in ProtoBuf format. It prefixes each protobuf with its encoded
- * size, the so called "delimited" format. */
-static void format_protobuf(ProtobufCBuffer *buffer) {
-  pthread_mutex_lock(&metrics_lock);
-
-  char *unused_name;
-  Io__Prometheus__Client__MetricFamily *fam;
-  c_avl_iterator_t *iter = c_avl_get_iterator(metrics);
-  while (c_avl_iterator_next(iter, (void *)&unused_name, (void *)&fam) == 0) {
-    /* Prometheus uses a message length prefix to determine where one
-     * MetricFamily ends and the next begins. This delimiter is encoded as a
-     * "varint", which is common in Protobufs. */
-    uint8_t delim[VARINT_UINT32_BYTES] = {0};
-    size_t delim_len = varint(
-        delim,
-        (uint32_t)io__prometheus__client__metric_family__get_packed_size(fam));
-    buffer->append(buffer, delim_len, delim);
-
-    io__prometheus__client__metric_family__pack_to_buffer(fam, buffer);
-  }
-  c_avl_iterator_destroy(iter);
-
-  pthread_mutex_unlock(&metrics_lock);
+/* format_protobuf adds a metric family to a buffer in ProtoBuf format. It
+ * prefixes the protobuf with its encoded size, the so called "delimited"
+ * format. */
+static void format_protobuf(ProtobufCBuffer *buffer,
+                            Io__Prometheus__Client__MetricFamily *fam) {
+  /* Prometheus uses a message length prefix to determine where one
+   * MetricFamily ends and the next begins. This delimiter is encoded as a
+   * "varint", which is common in Protobufs. */
+  uint8_t delim[VARINT_UINT32_BYTES] = {0};
+  size_t delim_len = varint(
+      delim,
+      (uint32_t)io__prometheus__client__metric_family__get_packed_size(fam));
+  buffer->append(buffer, delim_len, delim);
+
+  io__prometheus__client__metric_family__pack_to_buffer(fam, buffer);
 }
 
 static char const *escape_label_value(char *buffer, size_t buffer_size,
@@ -179,57 +303,371 @@ static char *format_labels(char *buffer, size_t buffer_size,
   return buffer;
 }
 
-/* format_protobuf iterates over all metric families in "metrics" and adds them
- * to a buffer in plain text format. */
-static void format_text(ProtobufCBuffer *buffer) {
-  pthread_mutex_lock(&metrics_lock);
+/* format_text adds a metric family to a buffer in plain text format. */
+static void format_text(ProtobufCBuffer *buffer,
+                        Io__Prometheus__Client__MetricFamily *fam) {
+  char line[1024]; /* 4x DATA_MAX_NAME_LEN? */
 
-  char *unused_name;
-  Io__Prometheus__Client__MetricFamily *fam;
-  c_avl_iterator_t *iter = c_avl_get_iterator(metrics);
-  while (c_avl_iterator_next(iter, (void *)&unused_name, (void *)&fam) == 0) {
-    char line[1024]; /* 4x DATA_MAX_NAME_LEN? */
+  ssnprintf(line, sizeof(line), "# HELP %s %s\n", fam->name, fam->help);
+  buffer->append(buffer, strlen(line), (uint8_t *)line);
 
-    ssnprintf(line, sizeof(line), "# HELP %s %s\n", fam->name, fam->help);
-    buffer->append(buffer, strlen(line), (uint8_t *)line);
+  ssnprintf(line, sizeof(line), "# TYPE %s %s\n", fam->name,
+            (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__GAUGE)
+                ? "gauge"
+                : "counter");
+  buffer->append(buffer, strlen(line), (uint8_t *)line);
+
+  for (size_t i = 0; i < fam->n_metric; i++) {
+    Io__Prometheus__Client__Metric *m = fam->metric[i];
+
+    char labels[1024];
+
+    char timestamp_ms[24] = "";
+    if (m->has_timestamp_ms)
+      ssnprintf(timestamp_ms, sizeof(timestamp_ms), " %" PRIi64,
+                m->timestamp_ms);
+
+    if (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__GAUGE)
+      ssnprintf(line, sizeof(line), "%s{%s} " GAUGE_FORMAT "%s\n", fam->name,
+                format_labels(labels, sizeof(labels), m), m->gauge->value,
+                timestamp_ms);
+    else /* if (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__COUNTER) */
+      ssnprintf(line, sizeof(line), "%s{%s} %.0f%s\n", fam->name,
+                format_labels(labels, sizeof(labels), m), m->counter->value,
+                timestamp_ms);
 
-    ssnprintf(line, sizeof(line), "# TYPE %s %s\n", fam->name,
-              (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__GAUGE)
-                  ? "gauge"
-                  : "counter");
     buffer->append(buffer, strlen(line), (uint8_t *)line);
+  }
+}
+
+/* metric_family_fragment returns a new reference to fam rendered in the given
+ * format. The family is only rendered if it changed since the last scrape.
+ * Must be called with the shard's lock held. */
+static prom_blob_t *
+metric_family_fragment(Io__Prometheus__Client__MetricFamily *fam, int format) {
+  prom_family_t *pf = (prom_family_t *)fam;
+
+  if (pf->fragment[format] == NULL) {
+    uint8_t scratch[4096] = {0};
+    ProtobufCBufferSimple simple = PROTOBUF_C_BUFFER_SIMPLE_INIT(scratch);
+    ProtobufCBuffer *buffer = (ProtobufCBuffer *)&simple;
+
+    if (format == FORMAT_PROTOBUF)
+      format_protobuf(buffer, fam);
+    else
+      format_text(buffer, fam);
+
+    prom_blob_t *b = blob_create(simple.len);
+    if (b != NULL)
+      memcpy(b->data, simple.data, simple.len);
+    PROTOBUF_C_BUFFER_SIMPLE_CLEAR(&simple);
+
+    if (b == NULL)
+      return NULL;
+    pf->fragment[format] = b;
+  }
+
+  return blob_ref(pf->fragment[format]);
+}
+
+/* response_fragments collects references to the fragments of all metric
+ * families in "metrics", followed by the server's comment in the text format.
+ * Only the families that changed are rendered while their shard's lock is
+ * held; everything else happens after it has been released, so that writers
+ * are not blocked by large scrapes.
+ * A family changing while the shards are visited bumps the generation past
+ * the one returned, so cached responses are rebuilt on the next scrape. */
+static prom_blob_t **response_fragments(int format, uint64_t *ret_generation,
+                                        size_t *ret_fragments_num) {
+  *ret_generation = __atomic_load_n(&metrics_generation, __ATOMIC_ACQUIRE);
+
+  prom_blob_t **fragments = NULL;
+  size_t fragments_num = 0;
+
+  for (size_t i = 0; i < PROMETHEUS_METRICS_SHARDS; i++) {
+    metrics_shard_t *shard = metrics + i;
+    pthread_mutex_lock(&shard->lock);
+
+    /* One spare slot for the server's comment. */
+    prom_blob_t **tmp =
+        realloc(fragments, (fragments_num + (size_t)c_avl_size(shard->families) +
+                            1) * sizeof(*fragments));
+    if (tmp == NULL) {
+      pthread_mutex_unlock(&shard->lock);
+      ERROR("write_prometheus plugin: realloc failed.");
+      break;
+    }
+    fragments = tmp;
+
+    char *unused_name;
+    Io__Prometheus__Client__MetricFamily *fam;
+    c_avl_iterator_t *iter = c_avl_get_iterator(shard->families);
+    while (c_avl_iterator_next(iter, (void *)&unused_name, (void *)&fam) ==
+           0) {
+      prom_blob_t *b = metric_family_fragment(fam, format);
+      if (b == NULL) {
+        ERROR("write_prometheus plugin: Rendering metric family \"%s\" "
+              "failed.",
+              fam->name);
+        continue;
+      }
+      fragments[fragments_num] = b;
+      fragments_num++;
+    }
+    c_avl_iterator_destroy(iter);
+
+    pthread_mutex_unlock(&shard->lock);
+  }
+
+  if (fragments == NULL) {
+    *ret_fragments_num = 0;
+    return NULL;
+  }
+
+  if (format == FORMAT_TEXT) {
+    char server[1024];
+    ssnprintf(server, sizeof(server),
+              "\n# collectd/write_prometheus %s at %s\n", PACKAGE_VERSION,
+              hostname_g);
+
+    prom_blob_t *b = blob_create(strlen(server));
+    if (b != NULL) {
+      memcpy(b->data, server, b->len);
+      fragments[fragments_num] = b;
+      fragments_num++;
+    }
+  }
+
+  *ret_fragments_num = fragments_num;
+  return fragments;
+}
+
+static void fragments_destroy(prom_blob_t **fragments, size_t fragments_num) {
+  for (size_t i = 0; i < fragments_num; i++)
+    blob_unref(fragments[i]);
+  sfree(fragments);
+}
+
+/* response_build copies the fragments of all metric families into a single
+ * response. */
+static prom_blob_t *response_build(int format, uint64_t *ret_generation) {
+  size_t fragments_num = 0;
+  prom_blob_t **fragments =
+      response_fragments(format, ret_generation, &fragments_num);
+  if (fragments == NULL)
+    return NULL;
+
+  size_t len = 0;
+  for (size_t i = 0; i < fragments_num; i++)
+    len += fragments[i]->len;
+
+  prom_blob_t *res = blob_create(len);
+  if (res != NULL) {
+    uint8_t *ptr = res->data;
+    for (size_t i = 0; i < fragments_num; i++) {
+      memcpy(ptr, fragments[i]->data, fragments[i]->len);
+      ptr += fragments[i]->len;
+    }
+  }
+
+  fragments_destroy(fragments, fragments_num);
+  return res;
+}
+
+/* response_cache_put stores b in the response cache, unless a response of a
+ * later generation has been stored in the meantime. */
+static void response_cache_put(int format, bool gzip, prom_blob_t *b,
+                               uint64_t generation) {
+  pthread_mutex_lock(&response_lock);
+  if ((response_cache[format][gzip] == NULL) ||
+      (response_generation[format][gzip] < generation)) {
+    blob_unref(response_cache[format][gzip]);
+    response_cache[format][gzip] = blob_ref(b);
+    response_generation[format][gzip] = generation;
+  }
+  pthread_mutex_unlock(&response_lock);
+}
+
+/* response_get returns a reference to the current response in the given
+ * format. Responses are reused until a metric changes, so that several
+ * Prometheus servers scraping the same instance share the work. */
+static prom_blob_t *response_get(int format, bool gzip) {
+  uint64_t current = __atomic_load_n(&metrics_generation, __ATOMIC_ACQUIRE);
+
+  pthread_mutex_lock(&response_lock);
+  prom_blob_t *cached = response_cache[format][gzip];
+  if ((cached != NULL) && (response_generation[format][gzip] == current)) {
+    blob_ref(cached);
+    pthread_mutex_unlock(&response_lock);
+    return cached;
+  }
+
+  /* A current plain response only needs to be compressed. */
+  uint64_t generation = response_generation[format][false];
+  prom_blob_t *plain = response_cache[format][false];
+  if ((plain != NULL) && (generation == current))
+    blob_ref(plain);
+  else
+    plain = NULL;
+  pthread_mutex_unlock(&response_lock);
+
+  if (plain == NULL) {
+    plain = response_build(format, &generation);
+    if (plain == NULL)
+      return NULL;
+    response_cache_put(format, false, plain, generation);
+  }
+
+#if HAVE_ZLIB
+  if (gzip) {
+    prom_blob_t *compressed = blob_gzip(plain);
+    blob_unref(plain);
+    if (compressed == NULL) {
+      ERROR("write_prometheus plugin: Compressing the response failed.");
+      return NULL;
+    }
+    response_cache_put(format, true, compressed, generation);
+    return compressed;
+  }
+#endif
+
+  return plain;
+}
+
+#if HAVE_PROM_STREAM
+/* prom_stream_t is the state of a streamed response. It holds references to
+ * the fragments making up the response, so memory used by the scrape itself
+ * is bounded by the size of the buffer passed to stream_read(). */
+typedef struct {
+  prom_blob_t **fragments;
+  size_t fragments_num;
+  size_t fragment;
+  size_t offset;
+
+  bool gzip;
+#if HAVE_ZLIB
+  z_stream z;
+  bool z_finished;
+#endif
+} prom_stream_t;
+
+static void stream_destroy(void *arg) {
+  prom_stream_t *st = arg;
+  if (st == NULL)
+    return;
+
+#if HAVE_ZLIB
+  if (st->gzip)
+    deflateEnd(&st->z);
+#endif
+
+  fragments_destroy(st->fragments, st->fragments_num);
+  sfree(st);
+}
+
+static prom_stream_t *stream_create(int format, bool gzip) {
+  prom_stream_t *st = calloc(1, sizeof(*st));
+  if (st == NULL)
+    return NULL;
+
+  uint64_t unused_generation;
+  st->fragments =
+      response_fragments(format, &unused_generation, &st->fragments_num);
+  if (st->fragments == NULL) {
+    sfree(st);
+    return NULL;
+  }
 
-    for (size_t i = 0; i < fam->n_metric; i++) {
-      Io__Prometheus__Client__Metric *m = fam->metric[i];
+#if HAVE_ZLIB
+  if (gzip) {
+    /* 15 + 16: the largest window, with a gzip header and trailer. */
+    if (deflateInit2(&st->z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+      stream_destroy(st);
+      return NULL;
+    }
+    st->gzip = true;
+  }
+#endif
 
-      char labels[1024];
+  return st;
+}
 
-      char timestamp_ms[24] = "";
-      if (m->has_timestamp_ms)
-        ssnprintf(timestamp_ms, sizeof(timestamp_ms), " %" PRIi64,
-                  m->timestamp_ms);
+/* stream_copy copies up to buffer_size bytes of the remaining fragments into
+ * buffer. */
+static size_t stream_copy(prom_stream_t *st, uint8_t *buffer,
+                          size_t buffer_size) {
+  size_t len = 0;
+
+  while ((len < buffer_size) && (st->fragment < st->fragments_num)) {
+    prom_blob_t *b = st->fragments[st->fragment];
+    size_t n = b->len - st->offset;
+    if (n > buffer_size - len)
+      n = buffer_size - len;
+
+    memcpy(buffer + len, b->data + st->offset, n);
+    len += n;
+    st->offset += n;
+
+    if (st->offset >= b->len) {
+      st->fragment++;
+      st->offset = 0;
+    }
+  }
 
-      if (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__GAUGE)
-        ssnprintf(line, sizeof(line), "%s{%s} " GAUGE_FORMAT "%s\n", fam->name,
-                  format_labels(labels, sizeof(labels), m), m->gauge->value,
-                  timestamp_ms);
-      else /* if (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__COUNTER) */
-        ssnprintf(line, sizeof(line), "%s{%s} %.0f%s\n", fam->name,
-                  format_labels(labels, sizeof(labels), m), m->counter->value,
-                  timestamp_ms);
+  return len;
+}
 
-      buffer->append(buffer, strlen(line), (uint8_t *)line);
+#if HAVE_ZLIB
+/* stream_deflate compresses the remaining fragments into buffer until it is
+ * full or the gzip stream has been finished. */
+static ssize_t stream_deflate(prom_stream_t *st, uint8_t *buffer,
+                              size_t buffer_size) {
+  st->z.next_out = buffer;
+  st->z.avail_out = (uInt)buffer_size;
+
+  while ((st->z.avail_out > 0) && !st->z_finished) {
+    if ((st->z.avail_in == 0) && (st->fragment < st->fragments_num)) {
+      prom_blob_t *b = st->fragments[st->fragment];
+      st->z.next_in = b->data;
+      st->z.avail_in = (uInt)b->len;
+      st->fragment++;
     }
+
+    int flush = ((st->z.avail_in == 0) && (st->fragment >= st->fragments_num))
+                    ? Z_FINISH
+                    : Z_NO_FLUSH;
+    int status = deflate(&st->z, flush);
+    if (status == Z_STREAM_END)
+      st->z_finished = true;
+    else if ((status != Z_OK) && (status != Z_BUF_ERROR))
+      return -1;
   }
-  c_avl_iterator_destroy(iter);
 
-  char server[1024];
-  ssnprintf(server, sizeof(server), "\n# collectd/write_prometheus %s at %s\n",
-            PACKAGE_VERSION, hostname_g);
-  buffer->append(buffer, strlen(server), (uint8_t *)server);
+  return (ssize_t)(buffer_size - st->z.avail_out);
+}
+#endif
 
-  pthread_mutex_unlock(&metrics_lock);
+/* stream_read is the content reader callback of streamed responses. */
+static ssize_t stream_read(void *arg, __attribute__((unused)) uint64_t pos,
+                           char *buffer, size_t buffer_size) {
+  prom_stream_t *st = arg;
+  ssize_t len = 0;
+
+#if HAVE_ZLIB
+  if (st->gzip) {
+    len = stream_deflate(st, (uint8_t *)buffer, buffer_size);
+    if (len < 0) {
+      ERROR("write_prometheus plugin: Compressing the response failed.");
+      return MHD_CONTENT_READER_END_WITH_ERROR;
+    }
+  } else
+#endif
+    len = (ssize_t)stream_copy(st, (uint8_t *)buffer, buffer_size);
+
+  return (len > 0) ? len : MHD_CONTENT_READER_END_OF_STREAM;
 }
+#endif /* HAVE_PROM_STREAM */
 
 /* http_handler is the callback called by the microhttpd library. It essentially
  * handles all HTTP request aspects and creates an HTTP response. */
@@ -256,35 +694,62 @@ static MHD_RESULT http_handler(void *cls, struct MHD_Connection *connection,
   bool want_proto = (accept != NULL) &&
                     (strstr(accept, "application/vnd.google.protobuf") != NULL);
 
-  uint8_t scratch[4096] = {0};
-  ProtobufCBufferSimple simple = PROTOBUF_C_BUFFER_SIMPLE_INIT(scratch);
-  ProtobufCBuffer *buffer = (ProtobufCBuffer *)&simple;
+  bool want_gzip = false;
+#if HAVE_ZLIB
+  char const *encoding = MHD_lookup_connection_value(
+      connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_ACCEPT_ENCODING);
+  want_gzip = (encoding != NULL) && (strstr(encoding, "gzip") != NULL);
+#endif
 
-  if (want_proto)
-    format_protobuf(buffer);
-  else
-    format_text(buffer);
+  int format = want_proto ? FORMAT_PROTOBUF : FORMAT_TEXT;
+  prom_blob_t *body = NULL;
+  struct MHD_Response *res = NULL;
+
+#if HAVE_PROM_STREAM
+  if (stream_responses) {
+    prom_stream_t *st = stream_create(format, want_gzip);
+    if (st == NULL)
+      return MHD_NO;
+
+    res = MHD_create_response_from_callback(
+        MHD_SIZE_UNKNOWN, PROMETHEUS_STREAM_BLOCK_SIZE, stream_read, st,
+        stream_destroy);
+    if (res == NULL) {
+      stream_destroy(st);
+      return MHD_NO;
+    }
+  }
+#endif
+
+  if (res == NULL) {
+    body = response_get(format, want_gzip);
+    if (body == NULL)
+      return MHD_NO;
 
 #if defined(MHD_VERSION) && MHD_VERSION >= 0x00090500
-  struct MHD_Response *res = MHD_create_response_from_buffer(
-      simple.len, simple.data, MHD_RESPMEM_MUST_COPY);
+    res = MHD_create_response_from_buffer(body->len, body->data,
+                                          MHD_RESPMEM_MUST_COPY);
 #else
-  struct MHD_Response *res = MHD_create_response_from_data(
-      simple.len, simple.data, /* must_free = */ 0, /* must_copy = */ 1);
+    res = MHD_create_response_from_data(body->len, body->data,
+                                        /* must_free = */ 0,
+                                        /* must_copy = */ 1);
 #endif
+  }
   MHD_add_response_header(res, MHD_HTTP_HEADER_CONTENT_TYPE,
                           want_proto ? CONTENT_TYPE_PROTO : CONTENT_TYPE_TEXT);
+  if (want_gzip)
+    MHD_add_response_header(res, MHD_HTTP_HEADER_CONTENT_ENCODING, "gzip");
 
   MHD_RESULT status = MHD_queue_response(connection, MHD_HTTP_OK, res);
 
   MHD_destroy_response(res);
-  PROTOBUF_C_BUFFER_SIMPLE_CLEAR(&simple);
+  blob_unref(body);
   return status;
 }
 
 /*
  * Functions for manipulating the global state in "metrics". This is organized
- * in two tiers: the global "metrics" tree holds "metric families", which are
+ * in two tiers: the global "metrics" trees hold "metric families", which are
  * identified by a name (a string). Each metric family has one or more
  * "metrics", which are identified by a unique set of key-value-pairs. For
  * example:
@@ -344,7 +809,8 @@ static void metric_destroy(Io__Prometheus__Client__Metric *msg) {
 }
 
 /* metric_cmp compares two metrics. It's prototype makes it easy to use with
- * qsort(3) and bsearch(3). */
+ * qsort(3) and bsearch(3); the families' hash indexes only check for
+ * equality. */
 static int metric_cmp(void const *a, void const *b) {
   Io__Prometheus__Client__Metric const *m_a =
       *((Io__Prometheus__Client__Metric **)a);
@@ -517,56 +983,142 @@ static int metric_update(Io__Prometheus__Client__Metric *m, value_t value,
   return 0;
 }
 
-/* metric_family_add_metric adds m to the metric list of fam. */
+/* metric_hash hashes the label values of m. Like metric_cmp(), it ignores the
+ * label names, which are the same for all metrics in a family. */
+static uint64_t metric_hash(Io__Prometheus__Client__Metric const *m) {
+  uint64_t hash = (uint64_t)m->n_label;
+  for (size_t i = 0; i < m->n_label; i++)
+    hash = (hash ^ hash_name(m->label[i]->value)) * 0x100000001b3ULL;
+  return hash;
+}
+
+/* family_index_slot returns the slot of the index holding the metric equal to
+ * key, or the empty slot at which it would be inserted. The index must not be
+ * empty. */
+static size_t *family_index_slot(prom_family_t *pf,
+                                 Io__Prometheus__Client__Metric const *key) {
+  size_t mask = pf->index_size - 1;
+
+  for (size_t i = (size_t)metric_hash(key) & mask;; i = (i + 1) & mask) {
+    size_t *slot = pf->index + i;
+    if ((*slot == 0) || (metric_cmp(&key, &pf->fam.metric[*slot - 1]) == 0))
+      return slot;
+  }
+}
+
+/* family_index_resize rebuilds the index of pf with size slots, which must be
+ * a power of two larger than the number of metrics. */
+static int family_index_resize(prom_family_t *pf, size_t size) {
+  size_t *index = calloc(size, sizeof(*index));
+  if (index == NULL)
+    return ENOMEM;
+
+  sfree(pf->index);
+  pf->index = index;
+  pf->index_size = size;
+
+  for (size_t i = 0; i < pf->fam.n_metric; i++)
+    *family_index_slot(pf, pf->fam.metric[i]) = i + 1;
+
+  return 0;
+}
+
+/* family_index_remove empties the slot at position i, moving the following
+ * entries of its probe sequence back so that they can still be found. */
+static void family_index_remove(prom_family_t *pf, size_t i) {
+  size_t mask = pf->index_size - 1;
+
+  for (size_t j = (i + 1) & mask; pf->index[j] != 0; j = (j + 1) & mask) {
+    size_t home =
+        (size_t)metric_hash(pf->fam.metric[pf->index[j] - 1]) & mask;
+    /* The entry at j may fill the hole unless its home slot lies between the
+     * hole and j. */
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      pf->index[i] = pf->index[j];
+      i = j;
+    }
+  }
+
+  pf->index[i] = 0;
+}
+
+/* metric_family_add_metric adds m to the metric list of fam. The list and the
+ * index grow by doubling, so that adding a metric takes amortized constant
+ * time. */
 static int metric_family_add_metric(Io__Prometheus__Client__MetricFamily *fam,
                                     Io__Prometheus__Client__Metric *m) {
-  Io__Prometheus__Client__Metric **tmp =
-      realloc(fam->metric, (fam->n_metric + 1) * sizeof(*fam->metric));
-  if (tmp == NULL)
-    return ENOMEM;
-  fam->metric = tmp;
+  prom_family_t *pf = (prom_family_t *)fam;
+
+  if (fam->n_metric >= pf->metric_size) {
+    size_t size = (pf->metric_size == 0) ? 8 : 2 * pf->metric_size;
+    Io__Prometheus__Client__Metric **tmp =
+        realloc(fam->metric, size * sizeof(*fam->metric));
+    if (tmp == NULL)
+      return ENOMEM;
+    fam->metric = tmp;
+    pf->metric_size = size;
+  }
+
+  /* Keep the index at most half full so that probe sequences stay short. */
+  if (2 * (fam->n_metric + 1) > pf->index_size) {
+    size_t size = (pf->index_size == 0) ? 16 : 2 * pf->index_size;
+    int status = family_index_resize(pf, size);
+    if (status != 0)
+      return status;
+  }
 
   fam->metric[fam->n_metric] = m;
   fam->n_metric++;
-
-  /* Sort the metrics so that lookup is fast. */
-  qsort(fam->metric, fam->n_metric, sizeof(*fam->metric), metric_cmp);
+  *family_index_slot(pf, m) = fam->n_metric;
 
   return 0;
 }
 
 /* metric_family_delete_metric looks up and deletes the metric corresponding to
- * vl. */
+ * vl. The last metric of the list takes its place. */
 static int
 metric_family_delete_metric(Io__Prometheus__Client__MetricFamily *fam,
                             value_list_t const *vl) {
+  prom_family_t *pf = (prom_family_t *)fam;
+  if (fam->n_metric == 0)
+    return ENOENT;
+
   Io__Prometheus__Client__Metric *key = METRIC_INIT;
   METRIC_ADD_LABELS(key, vl);
 
-  size_t i;
-  for (i = 0; i < fam->n_metric; i++) {
-    if (metric_cmp(&key, &fam->metric[i]) == 0)
-      break;
-  }
-
-  if (i >= fam->n_metric)
+  size_t *slot = family_index_slot(pf, key);
+  if (*slot == 0)
     return ENOENT;
 
+  size_t i = *slot - 1;
+  size_t last = fam->n_metric - 1;
+  family_index_remove(pf, (size_t)(slot - pf->index));
+
   metric_destroy(fam->metric[i]);
-  if ((fam->n_metric - 1) > i)
-    memmove(&fam->metric[i], &fam->metric[i + 1],
-            ((fam->n_metric - 1) - i) * sizeof(fam->metric[i]));
+  if (i != last) {
+    fam->metric[i] = fam->metric[last];
+    *family_index_slot(pf, fam->metric[i]) = i + 1;
+  }
   fam->n_metric--;
+  metric_family_invalidate(fam);
 
   if (fam->n_metric == 0) {
     sfree(fam->metric);
+    pf->metric_size = 0;
+    sfree(pf->index);
+    pf->index_size = 0;
     return 0;
   }
 
-  Io__Prometheus__Client__Metric **tmp =
-      realloc(fam->metric, fam->n_metric * sizeof(*fam->metric));
-  if (tmp != NULL)
-    fam->metric = tmp;
+  /* Shrink lazily, so that churning series don't reallocate all the time. */
+  if (4 * fam->n_metric < pf->metric_size) {
+    Io__Prometheus__Client__Metric **tmp =
+        realloc(fam->metric, (pf->metric_size / 2) * sizeof(*fam->metric));
+    if (tmp != NULL) {
+      fam->metric = tmp;
+      pf->metric_size /= 2;
+    }
+  }
 
   return 0;
 }
@@ -576,16 +1128,15 @@ metric_family_delete_metric(Io__Prometheus__Client__MetricFamily *fam,
 static Io__Prometheus__Client__Metric *
 metric_family_get_metric(Io__Prometheus__Client__MetricFamily *fam,
                          value_list_t const *vl) {
+  prom_family_t *pf = (prom_family_t *)fam;
+
   Io__Prometheus__Client__Metric *key = METRIC_INIT;
   METRIC_ADD_LABELS(key, vl);
 
-  /* Metrics are sorted in metric_family_add_metric() so that we can do a binary
-   * search here. */
-  Io__Prometheus__Client__Metric **m = bsearch(
-      &key, fam->metric, fam->n_metric, sizeof(*fam->metric), metric_cmp);
-
-  if (m != NULL) {
-    return *m;
+  if (fam->n_metric > 0) {
+    size_t *slot = family_index_slot(pf, key);
+    if (*slot != 0)
+      return fam->metric[*slot - 1];
   }
 
   Io__Prometheus__Client__Metric *new_metric = metric_clone(key);
@@ -611,8 +1162,10 @@ static int metric_family_update(Io__Prometheus__Client__MetricFamily *fam,
   if (m == NULL)
     return -1;
 
-  return metric_update(m, vl->values[ds_index], ds->ds[ds_index].type, vl->time,
-                       vl->interval);
+  int status = metric_update(m, vl->values[ds_index], ds->ds[ds_index].type,
+                             vl->time, vl->interval);
+  metric_family_invalidate(fam);
+  return status;
 }
 
 /* metric_family_destroy frees the memory used by a metric family. */
@@ -628,16 +1181,23 @@ static void metric_family_destroy(Io__Prometheus__Client__MetricFamily *msg) {
   }
   sfree(msg->metric);
 
-  sfree(msg);
+  prom_family_t *pf = (prom_family_t *)msg;
+  for (size_t i = 0; i < FORMAT_NUM; i++) {
+    blob_unref(pf->fragment[i]);
+  }
+  sfree(pf->index);
+
+  sfree(pf);
 }
 
 /* metric_family_create allocates and initializes a new metric family. */
 static Io__Prometheus__Client__MetricFamily *
 metric_family_create(char *name, data_set_t const *ds, value_list_t const *vl,
                      size_t ds_index) {
-  Io__Prometheus__Client__MetricFamily *msg = calloc(1, sizeof(*msg));
-  if (msg == NULL)
+  prom_family_t *pf = calloc(1, sizeof(*pf));
+  if (pf == NULL)
     return NULL;
+  Io__Prometheus__Client__MetricFamily *msg = &pf->fam;
   io__prometheus__client__metric_family__init(msg);
 
   msg->name = name;
@@ -693,19 +1253,14 @@ static char *metric_family_name(data_set_t const *ds, value_list_t const *vl,
   return strdup(name);
 }
 
-/* metric_family_get looks up the matching metric family, allocating it if
- * necessary. */
+/* metric_family_get looks up the metric family called name in shard,
+ * allocating it if necessary. It takes ownership of name. Must be called with
+ * the shard's lock held. */
 static Io__Prometheus__Client__MetricFamily *
-metric_family_get(data_set_t const *ds, value_list_t const *vl, size_t ds_index,
-                  bool allocate) {
-  char *name = metric_family_name(ds, vl, ds_index);
-  if (name == NULL) {
-    ERROR("write_prometheus plugin: Allocating metric family name failed.");
-    return NULL;
-  }
-
+metric_family_get(metrics_shard_t *shard, char *name, data_set_t const *ds,
+                  value_list_t const *vl, size_t ds_index, bool allocate) {
   Io__Prometheus__Client__MetricFamily *fam = NULL;
-  if (c_avl_get(metrics, name, (void *)&fam) == 0) {
+  if (c_avl_get(shard->families, name, (void *)&fam) == 0) {
     sfree(name);
     assert(fam != NULL);
     return fam;
@@ -728,7 +1283,7 @@ metric_family_get(data_set_t const *ds, value_list_t const *vl, size_t ds_index,
         name);
   name = NULL;
 
-  int status = c_avl_insert(metrics, fam->name, fam);
+  int status = c_avl_insert(shard->families, fam->name, fam);
   if (status != 0) {
     ERROR("write_prometheus plugin: Adding \"%s\" failed.", fam->name);
     metric_family_destroy(fam);
@@ -883,6 +1438,14 @@ static int prom_config(oconfig_item_t *ci) {
         httpd_port = (unsigned short)status;
     } else if (strcasecmp("StalenessDelta", child->key) == 0) {
       cf_util_get_cdtime(child, &staleness_delta);
+    } else if (strcasecmp("StreamResponses", child->key) == 0) {
+#if HAVE_PROM_STREAM
+      cf_util_get_boolean(child, &stream_responses);
+#else
+      ERROR("write_prometheus plugin: Option `StreamResponses' not supported. "
+            "Please upgrade libmicrohttpd.");
+      return -1;
+#endif
     } else {
       WARNING("write_prometheus plugin: Ignoring unknown configuration option "
               "\"%s\".",
@@ -894,9 +1457,12 @@ static int prom_config(oconfig_item_t *ci) {
 }
 
 static int prom_init() {
-  if (metrics == NULL) {
-    metrics = c_avl_create((void *)strcmp);
-    if (metrics == NULL) {
+  for (size_t i = 0; i < PROMETHEUS_METRICS_SHARDS; i++) {
+    if (metrics[i].families != NULL)
+      continue;
+
+    metrics[i].families = c_avl_create((void *)strcmp);
+    if (metrics[i].families == NULL) {
       ERROR("write_prometheus plugin: c_avl_create() failed.");
       return -1;
     }
@@ -916,24 +1482,29 @@ static int prom_init() {
 
 static int prom_write(data_set_t const *ds, value_list_t const *vl,
                       __attribute__((unused)) user_data_t *ud) {
-  pthread_mutex_lock(&metrics_lock);
-
   for (size_t i = 0; i < ds->ds_num; i++) {
-    Io__Prometheus__Client__MetricFamily *fam =
-        metric_family_get(ds, vl, i, /* allocate = */ true);
-    if (fam == NULL)
+    char *name = metric_family_name(ds, vl, i);
+    if (name == NULL) {
+      ERROR("write_prometheus plugin: Allocating metric family name failed.");
       continue;
+    }
 
-    int status = metric_family_update(fam, ds, vl, i);
-    if (status != 0) {
-      ERROR("write_prometheus plugin: Updating metric \"%s\" failed with "
-            "status %d",
-            fam->name, status);
-      continue;
+    metrics_shard_t *shard = metrics_shard(name);
+    pthread_mutex_lock(&shard->lock);
+
+    Io__Prometheus__Client__MetricFamily *fam =
+        metric_family_get(shard, name, ds, vl, i, /* allocate = */ true);
+    if (fam != NULL) {
+      int status = metric_family_update(fam, ds, vl, i);
+      if (status != 0)
+        ERROR("write_prometheus plugin: Updating metric \"%s\" failed with "
+              "status %d",
+              fam->name, status);
     }
+
+    pthread_mutex_unlock(&shard->lock);
   }
 
-  pthread_mutex_unlock(&metrics_lock);
   return 0;
 }
 
@@ -943,36 +1514,41 @@ static int prom_missing(value_list_t const *vl,
   if (ds == NULL)
     return ENOENT;
 
-  pthread_mutex_lock(&metrics_lock);
-
   for (size_t i = 0; i < ds->ds_num; i++) {
+    char *name = metric_family_name(ds, vl, i);
+    if (name == NULL) {
+      ERROR("write_prometheus plugin: Allocating metric family name failed.");
+      continue;
+    }
+
+    metrics_shard_t *shard = metrics_shard(name);
+    pthread_mutex_lock(&shard->lock);
+
     Io__Prometheus__Client__MetricFamily *fam =
-        metric_family_get(ds, vl, i, /* allocate = */ false);
-    if (fam == NULL)
+        metric_family_get(shard, name, ds, vl, i, /* allocate = */ false);
+    if (fam == NULL) {
+      pthread_mutex_unlock(&shard->lock);
       continue;
+    }
 
     int status = metric_family_delete_metric(fam, vl);
     if (status != 0) {
       ERROR("write_prometheus plugin: Deleting a metric in family \"%s\" "
             "failed with status %d",
             fam->name, status);
-
-      continue;
-    }
-
-    if (fam->n_metric == 0) {
-      int status = c_avl_remove(metrics, fam->name, NULL, NULL);
-      if (status != 0) {
+    } else if (fam->n_metric == 0) {
+      status = c_avl_remove(shard->families, fam->name, NULL, NULL);
+      if (status != 0)
         ERROR("write_prometheus plugin: Deleting metric family \"%s\" failed "
               "with status %d",
               fam->name, status);
-        continue;
-      }
-      metric_family_destroy(fam);
+      else
+        metric_family_destroy(fam);
     }
+
+    pthread_mutex_unlock(&shard->lock);
   }
 
-  pthread_mutex_unlock(&metrics_lock);
   return 0;
 }
 
@@ -982,20 +1558,33 @@ static int prom_shutdown() {
     httpd = NULL;
   }
 
-  pthread_mutex_lock(&metrics_lock);
-  if (metrics != NULL) {
-    char *name;
-    Io__Prometheus__Client__MetricFamily *fam;
-    while (c_avl_pick(metrics, (void *)&name, (void *)&fam) == 0) {
-      assert(name == fam->name);
-      name = NULL;
+  for (size_t i = 0; i < PROMETHEUS_METRICS_SHARDS; i++) {
+    metrics_shard_t *shard = metrics + i;
 
-      metric_family_destroy(fam);
+    pthread_mutex_lock(&shard->lock);
+    if (shard->families != NULL) {
+      char *name;
+      Io__Prometheus__Client__MetricFamily *fam;
+      while (c_avl_pick(shard->families, (void *)&name, (void *)&fam) == 0) {
+        assert(name == fam->name);
+        name = NULL;
+
+        metric_family_destroy(fam);
+      }
+      c_avl_destroy(shard->families);
+      shard->families = NULL;
+    }
+    pthread_mutex_unlock(&shard->lock);
+  }
+
+  pthread_mutex_lock(&response_lock);
+  for (size_t i = 0; i < FORMAT_NUM; i++) {
+    for (size_t j = 0; j < 2; j++) {
+      blob_unref(response_cache[i][j]);
+      response_cache[i][j] = NULL;
     }
-    c_avl_destroy(metrics);
-    metrics = NULL;
   }
-  pthread_mutex_unlock(&metrics_lock);
+  pthread_mutex_unlock(&response_lock);
 
   sfree(httpd_host);
 
@@ -1003,6 +1592,9 @@ static int prom_shutdown() {
 }
 
 void module_register() {
+  for (size_t i = 0; i < PROMETHEUS_METRICS_SHARDS; i++)
+    pthread_mutex_init(&metrics[i].lock, /* attr = */ NULL);
+
   plugin_register_complex_config("write_prometheus", prom_config);
   plugin_register_init("write_prometheus", prom_init);
   plugin_register_write("write_prometheus", prom_write,
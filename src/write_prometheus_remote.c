@@ -0,0 +1,910 @@
+/**
+ * collectd - src/write_prometheus_remote.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+/*
+ * Pushes values to a Prometheus "remote write" receiver, such as Prometheus
+ * itself, Mimir, Cortex, Thanos or VictoriaMetrics. See
+ * <https://prometheus.io/docs/specs/remote_write_spec/>.
+ *
+ * Every data source becomes a time series, named and labeled like the metrics
+ * exported by the write_prometheus plugin. Samples are spread over a number of
+ * shards by their series, so that the samples of a series stay in order. Each
+ * shard has a bounded queue of batches and a thread sending them: a batch is
+ * sent as a snappy compressed prompb.WriteRequest when it is full or when its
+ * oldest sample is BatchSendDeadline old. Failed requests are retried with
+ * exponential backoff; while they are, the queue fills up and eventually
+ * blocks the plugin's write thread, which pushes back to collectd's write
+ * queue.
+ *
+ * The WriteRequest messages are encoded directly: they only need a few
+ * fields, so there is no dependency on a protobuf library.
+ */
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils/common/common.h"
+#include "utils/snappy/snappy.h"
+#include "utils_complain.h"
+#include "utils_time.h"
+
+#include <curl/curl.h>
+
+#ifndef WPR_DEFAULT_SHARDS
+#define WPR_DEFAULT_SHARDS 4
+#endif
+#define WPR_SHARDS_MAX 1000
+
+/* Protobuf wire types */
+#define PB_VARINT 0
+#define PB_FIXED64 1
+#define PB_LEN 2
+#define PB_TAG(field, type) ((uint8_t)(((field) << 3) | (type)))
+
+/* Encoded size of a time series: the name, three labels and a sample, each
+ * at most DATA_MAX_NAME_LEN or 5 * DATA_MAX_NAME_LEN long, plus framing. */
+#define WPR_SERIES_MAX (16 * DATA_MAX_NAME_LEN)
+
+/*
+ * Private data types
+ */
+typedef struct {
+  uint8_t *data;
+  size_t len;
+  size_t size;
+} wpr_buffer_t;
+
+/* A batch holds encoded "timeseries" fields of a WriteRequest, so that the
+ * buffer is a complete WriteRequest message. */
+typedef struct {
+  wpr_buffer_t buffer;
+  size_t samples_num;
+  cdtime_t created;
+} wpr_batch_t;
+
+struct wpr_node_s;
+
+typedef struct {
+  struct wpr_node_s *node;
+  size_t index;
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;  /* signals the sender */
+  pthread_cond_t space; /* signals writers waiting for a free batch */
+
+  /* Ring of batches. */
+  wpr_batch_t *batches;
+  size_t batches_size;
+  size_t batches_head;
+  size_t batches_num;
+
+  /* Set when a writer gave up waiting for space. Until space is available
+   * again, samples for this shard are dropped right away. */
+  bool overflow;
+  uint64_t dropped;
+  c_complain_t overflow_complaint;
+  c_complain_t complaint;
+
+  bool shutdown;
+  pthread_t thread;
+  bool thread_running;
+
+  CURL *curl;
+  char curl_errbuf[CURL_ERROR_SIZE];
+  char response[256];
+  size_t response_len;
+} wpr_shard_t;
+
+typedef struct wpr_node_s {
+  char *name;
+  char *url;
+  char *user;
+  char *pass;
+  char *cacert;
+  bool verify_peer;
+  bool verify_host;
+  struct curl_slist *headers;
+  cdtime_t timeout;
+
+  size_t shards_num;
+  size_t capacity;
+  size_t max_samples;
+  cdtime_t deadline;
+  cdtime_t min_backoff;
+  cdtime_t max_backoff;
+  cdtime_t enqueue_timeout;
+
+  wpr_shard_t *shards;
+  bool started;
+
+  struct wpr_node_s *next;
+} wpr_node_t;
+
+/*
+ * Private variables
+ */
+static wpr_node_t *nodes;
+
+/*
+ * Protobuf encoding
+ */
+static size_t varint_size(uint64_t v) {
+  size_t n = 1;
+  while (v >= 0x80) {
+    v >>= 7;
+    n++;
+  }
+  return n;
+}
+
+static uint8_t *put_varint(uint8_t *p, uint64_t v) {
+  while (v >= 0x80) {
+    *p++ = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  *p++ = (uint8_t)v;
+  return p;
+}
+
+static uint8_t *put_bytes(uint8_t *p, uint8_t field, void const *data,
+                          size_t len) {
+  *p++ = PB_TAG(field, PB_LEN);
+  p = put_varint(p, len);
+  memcpy(p, data, len);
+  return p + len;
+}
+
+static size_t bytes_size(size_t len) { return 1 + varint_size(len) + len; }
+
+typedef struct {
+  char const *name;
+  char const *value;
+} wpr_label_t;
+
+static int label_cmp(void const *a, void const *b) {
+  return strcmp(((wpr_label_t const *)a)->name,
+                ((wpr_label_t const *)b)->name);
+}
+
+/* Creates a metric name from a data source, in the same way as the
+ * write_prometheus plugin and the "collectd_exporter" do: the plugin, type and
+ * data source name go into the name, while host, plugin instance and type
+ * instance become labels. */
+static void metric_name(char *buffer, size_t buffer_size,
+                        data_set_t const *ds, value_list_t const *vl,
+                        size_t ds_index) /* {{{ */
+{
+  char const *fields[5] = {"collectd"};
+  size_t fields_num = 1;
+
+  if (strcmp(vl->plugin, vl->type) != 0)
+    fields[fields_num++] = vl->plugin;
+  fields[fields_num++] = vl->type;
+
+  if (strcmp("value", ds->ds[ds_index].name) != 0)
+    fields[fields_num++] = ds->ds[ds_index].name;
+
+  /* Prometheus best practices:
+   * cumulative metrics should have a "total" suffix. */
+  if ((ds->ds[ds_index].type == DS_TYPE_COUNTER) ||
+      (ds->ds[ds_index].type == DS_TYPE_DERIVE))
+    fields[fields_num++] = "total";
+
+  strjoin(buffer, buffer_size, (char **)fields, fields_num, "_");
+} /* }}} void metric_name */
+
+/* Returns the labels of `vl', the same as write_prometheus uses, sorted by
+ * name as the remote write protocol requires. */
+static size_t metric_labels(wpr_label_t labels[static 4], char const *name,
+                            value_list_t const *vl) /* {{{ */
+{
+  size_t num = 0;
+
+  labels[num++] = (wpr_label_t){"__name__", name};
+  if (strlen(vl->plugin_instance) != 0)
+    labels[num++] = (wpr_label_t){vl->plugin, vl->plugin_instance};
+  if (strlen(vl->type_instance) != 0)
+    labels[num++] = (wpr_label_t){
+        (strlen(vl->plugin_instance) != 0) ? "type" : vl->plugin,
+        vl->type_instance};
+  labels[num++] = (wpr_label_t){"instance", vl->host};
+
+  qsort(labels, num, sizeof(*labels), label_cmp);
+  return num;
+} /* }}} size_t metric_labels */
+
+/* FNV-1a */
+static uint64_t series_hash(uint8_t const *data, size_t len) {
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < len; i++) {
+    h ^= data[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+/* Encodes one data source as a "timeseries" field of a WriteRequest into
+ * `buffer', which has room for WPR_SERIES_MAX bytes. `ret_hash' is set to the
+ * hash of the encoded labels, which identify the series. */
+static size_t encode_series(uint8_t *buffer, data_set_t const *ds,
+                            value_list_t const *vl, size_t ds_index,
+                            uint64_t *ret_hash) /* {{{ */
+{
+  char name[5 * DATA_MAX_NAME_LEN];
+  metric_name(name, sizeof(name), ds, vl, ds_index);
+
+  wpr_label_t labels[4];
+  size_t labels_num = metric_labels(labels, name, vl);
+
+  gauge_t value;
+  switch (ds->ds[ds_index].type) {
+  case DS_TYPE_GAUGE:
+    value = vl->values[ds_index].gauge;
+    break;
+  case DS_TYPE_DERIVE:
+    value = (gauge_t)vl->values[ds_index].derive;
+    break;
+  case DS_TYPE_COUNTER:
+    value = (gauge_t)vl->values[ds_index].counter;
+    break;
+  default: /* DS_TYPE_ABSOLUTE */
+    value = (gauge_t)vl->values[ds_index].absolute;
+    break;
+  }
+  int64_t timestamp = (int64_t)CDTIME_T_TO_MS(vl->time);
+
+  /* message Label { string name = 1; string value = 2; } */
+  size_t label_len[4];
+  size_t series_len = 0;
+  for (size_t i = 0; i < labels_num; i++) {
+    label_len[i] = bytes_size(strlen(labels[i].name)) +
+                   bytes_size(strlen(labels[i].value));
+    series_len += bytes_size(label_len[i]);
+  }
+  /* message Sample { double value = 1; int64 timestamp = 2; } */
+  size_t sample_len = 1 + 8 + 1 + varint_size((uint64_t)timestamp);
+  series_len += bytes_size(sample_len);
+  assert(bytes_size(series_len) <= WPR_SERIES_MAX);
+
+  /* message TimeSeries { repeated Label labels = 1;
+   *                      repeated Sample samples = 2; } */
+  uint8_t *p = buffer;
+  *p++ = PB_TAG(1, PB_LEN); /* WriteRequest.timeseries */
+  p = put_varint(p, series_len);
+  uint8_t const *labels_start = p;
+  for (size_t i = 0; i < labels_num; i++) {
+    *p++ = PB_TAG(1, PB_LEN);
+    p = put_varint(p, label_len[i]);
+    p = put_bytes(p, 1, labels[i].name, strlen(labels[i].name));
+    p = put_bytes(p, 2, labels[i].value, strlen(labels[i].value));
+  }
+  *ret_hash = series_hash(labels_start, (size_t)(p - labels_start));
+
+  *p++ = PB_TAG(2, PB_LEN);
+  p = put_varint(p, sample_len);
+  *p++ = PB_TAG(1, PB_FIXED64);
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  for (size_t i = 0; i < 8; i++)
+    *p++ = (uint8_t)(bits >> (8 * i));
+  *p++ = PB_TAG(2, PB_VARINT);
+  p = put_varint(p, (uint64_t)timestamp);
+
+  return (size_t)(p - buffer);
+} /* }}} size_t encode_series */
+
+/*
+ * Shards
+ */
+static size_t wpr_curl_write(char *ptr, size_t size, size_t nmemb,
+                             void *arg) /* {{{ */
+{
+  wpr_shard_t *s = arg;
+  size_t len = size * nmemb;
+
+  /* Keep the start of the response for error messages. */
+  size_t copy = sizeof(s->response) - 1 - s->response_len;
+  if (copy > len)
+    copy = len;
+  memcpy(s->response + s->response_len, ptr, copy);
+  s->response_len += copy;
+  s->response[s->response_len] = 0;
+
+  return len;
+} /* }}} size_t wpr_curl_write */
+
+static int wpr_curl_init(wpr_shard_t *s) /* {{{ */
+{
+  wpr_node_t *n = s->node;
+
+  s->curl = curl_easy_init();
+  if (s->curl == NULL)
+    return -1;
+
+  curl_easy_setopt(s->curl, CURLOPT_URL, n->url);
+  curl_easy_setopt(s->curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(s->curl, CURLOPT_USERAGENT, COLLECTD_USERAGENT);
+  curl_easy_setopt(s->curl, CURLOPT_HTTPHEADER, n->headers);
+  curl_easy_setopt(s->curl, CURLOPT_ERRORBUFFER, s->curl_errbuf);
+  curl_easy_setopt(s->curl, CURLOPT_WRITEFUNCTION, wpr_curl_write);
+  curl_easy_setopt(s->curl, CURLOPT_WRITEDATA, s);
+  curl_easy_setopt(s->curl, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(s->curl, CURLOPT_MAXREDIRS, 50L);
+#ifdef HAVE_CURLOPT_TIMEOUT_MS
+  if (n->timeout > 0)
+    curl_easy_setopt(s->curl, CURLOPT_TIMEOUT_MS,
+                     (long)CDTIME_T_TO_MS(n->timeout));
+#endif
+
+  if (n->user != NULL) {
+#ifdef HAVE_CURLOPT_USERNAME
+    curl_easy_setopt(s->curl, CURLOPT_USERNAME, n->user);
+    curl_easy_setopt(s->curl, CURLOPT_PASSWORD,
+                     (n->pass == NULL) ? "" : n->pass);
+    curl_easy_setopt(s->curl, CURLOPT_HTTPAUTH, CURLAUTH_ANY);
+#else
+    WARNING("write_prometheus_remote plugin: libcurl is too old to support "
+            "User and Password.");
+#endif
+  }
+
+  curl_easy_setopt(s->curl, CURLOPT_SSL_VERIFYPEER, (long)n->verify_peer);
+  curl_easy_setopt(s->curl, CURLOPT_SSL_VERIFYHOST, n->verify_host ? 2L : 0L);
+  if (n->cacert != NULL)
+    curl_easy_setopt(s->curl, CURLOPT_CAINFO, n->cacert);
+
+  return 0;
+} /* }}} int wpr_curl_init */
+
+/* Waits until `until' or until the shard is shut down. Must be called with
+ * the shard's lock held. */
+static void wpr_shard_sleep(wpr_shard_t *s, cdtime_t until) /* {{{ */
+{
+  struct timespec ts = CDTIME_T_TO_TIMESPEC(until);
+  while (!s->shutdown && (cdtime() < until))
+    pthread_cond_timedwait(&s->cond, &s->lock, &ts);
+} /* }}} void wpr_shard_sleep */
+
+/* Sends a batch, retrying until it is accepted, rejected for good or the
+ * shard is shut down. */
+static void wpr_shard_send(wpr_shard_t *s, wpr_batch_t const *b) /* {{{ */
+{
+  wpr_node_t *n = s->node;
+
+  size_t len = snappy_max_compressed_length(b->buffer.len);
+  uint8_t *data = malloc(len);
+  if (data == NULL) {
+    ERROR("write_prometheus_remote plugin: \"%s\": Dropping %" PRIsz
+          " samples: malloc failed.",
+          n->name, b->samples_num);
+    return;
+  }
+  len = snappy_compress(b->buffer.data, b->buffer.len, data);
+
+  curl_easy_setopt(s->curl, CURLOPT_POSTFIELDS, data);
+  curl_easy_setopt(s->curl, CURLOPT_POSTFIELDSIZE, (long)len);
+
+  cdtime_t backoff = n->min_backoff;
+  while (true) {
+    s->curl_errbuf[0] = 0;
+    s->response[0] = 0;
+    s->response_len = 0;
+
+    long code = 0;
+    CURLcode status = curl_easy_perform(s->curl);
+    if (status == CURLE_OK)
+      curl_easy_getinfo(s->curl, CURLINFO_RESPONSE_CODE, &code);
+
+    if ((code >= 200) && (code < 300)) {
+      pthread_mutex_lock(&s->lock);
+      c_release(LOG_INFO, &s->complaint,
+                "write_prometheus_remote plugin: \"%s\": Sending succeeded "
+                "again.",
+                n->name);
+      pthread_mutex_unlock(&s->lock);
+      break;
+    }
+
+    /* Everything but 429 ("Too Many Requests") and server errors means the
+     * data will never be accepted. */
+    bool retry = (status != CURLE_OK) || (code == 429) || (code >= 500);
+    if (!retry) {
+      ERROR("write_prometheus_remote plugin: \"%s\": The receiver rejected "
+            "%" PRIsz " samples with status %ld: %s",
+            n->name, b->samples_num, code, s->response);
+      break;
+    }
+
+    pthread_mutex_lock(&s->lock);
+    bool shutdown = s->shutdown;
+    if (!shutdown) {
+      c_complain(LOG_WARNING, &s->complaint,
+                 "write_prometheus_remote plugin: \"%s\": Sending failed "
+                 "(%s), retrying.",
+                 n->name,
+                 (status != CURLE_OK) ? s->curl_errbuf : s->response);
+      wpr_shard_sleep(s, cdtime() + backoff);
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    if (shutdown) {
+      ERROR("write_prometheus_remote plugin: \"%s\": Dropping %" PRIsz
+            " samples on shutdown: %s",
+            n->name, b->samples_num,
+            (status != CURLE_OK) ? s->curl_errbuf : s->response);
+      break;
+    }
+
+    backoff *= 2;
+    if (backoff > n->max_backoff)
+      backoff = n->max_backoff;
+  }
+
+  free(data);
+} /* }}} void wpr_shard_send */
+
+static void *wpr_shard_thread(void *arg) /* {{{ */
+{
+  wpr_shard_t *s = arg;
+  wpr_node_t *n = s->node;
+
+  pthread_mutex_lock(&s->lock);
+  while (true) {
+    if (s->batches_num == 0) {
+      if (s->shutdown)
+        break;
+      pthread_cond_wait(&s->cond, &s->lock);
+      continue;
+    }
+
+    /* Only the last batch can be incomplete. */
+    wpr_batch_t *head = s->batches + s->batches_head;
+    cdtime_t deadline = head->created + n->deadline;
+    if (!s->shutdown && (s->batches_num == 1) &&
+        (head->samples_num < n->max_samples) && (cdtime() < deadline)) {
+      struct timespec ts = CDTIME_T_TO_TIMESPEC(deadline);
+      pthread_cond_timedwait(&s->cond, &s->lock, &ts);
+      continue;
+    }
+
+    wpr_batch_t batch = *head;
+    *head = (wpr_batch_t){0};
+    s->batches_head = (s->batches_head + 1) % s->batches_size;
+    s->batches_num--;
+    if (s->overflow)
+      c_release(LOG_INFO, &s->overflow_complaint,
+                "write_prometheus_remote plugin: \"%s\": Shard %" PRIsz
+                " accepts samples again.",
+                n->name, s->index);
+    s->overflow = false;
+    pthread_cond_broadcast(&s->space);
+    pthread_mutex_unlock(&s->lock);
+
+    wpr_shard_send(s, &batch);
+    free(batch.buffer.data);
+
+    pthread_mutex_lock(&s->lock);
+  }
+  pthread_mutex_unlock(&s->lock);
+
+  return NULL;
+} /* }}} void *wpr_shard_thread */
+
+/* Appends an encoded series to the shard's last batch, waiting for space if
+ * all batches are full. */
+static int wpr_shard_enqueue(wpr_shard_t *s, uint8_t const *data,
+                             size_t len) /* {{{ */
+{
+  wpr_node_t *n = s->node;
+
+  pthread_mutex_lock(&s->lock);
+
+  wpr_batch_t *tail = NULL;
+  if (s->batches_num > 0)
+    tail = s->batches +
+           (s->batches_head + s->batches_num - 1) % s->batches_size;
+
+  if ((tail == NULL) || (tail->samples_num >= n->max_samples)) {
+    cdtime_t until = cdtime() + n->enqueue_timeout;
+    struct timespec ts = CDTIME_T_TO_TIMESPEC(until);
+
+    while (!s->overflow && !s->shutdown &&
+           (s->batches_num == s->batches_size)) {
+      if (pthread_cond_timedwait(&s->space, &s->lock, &ts) == ETIMEDOUT)
+        s->overflow = (s->batches_num == s->batches_size);
+    }
+
+    if (s->batches_num == s->batches_size) {
+      s->dropped++;
+      c_complain(LOG_WARNING, &s->overflow_complaint,
+                 "write_prometheus_remote plugin: \"%s\": The queue of shard "
+                 "%" PRIsz " is full, dropping samples.",
+                 n->name, s->index);
+      pthread_mutex_unlock(&s->lock);
+      return ENOBUFS;
+    }
+
+    tail = s->batches +
+           (s->batches_head + s->batches_num) % s->batches_size;
+    *tail = (wpr_batch_t){.created = cdtime()};
+    s->batches_num++;
+    if (s->batches_num == 1)
+      pthread_cond_signal(&s->cond);
+  }
+
+  wpr_buffer_t *b = &tail->buffer;
+  if (b->size - b->len < len) {
+    size_t size = (b->size > 0) ? 2 * b->size : 64 * n->max_samples;
+    while (size - b->len < len)
+      size *= 2;
+    uint8_t *tmp = realloc(b->data, size);
+    if (tmp == NULL) {
+      pthread_mutex_unlock(&s->lock);
+      return ENOMEM;
+    }
+    b->data = tmp;
+    b->size = size;
+  }
+  memcpy(b->data + b->len, data, len);
+  b->len += len;
+  tail->samples_num++;
+
+  if (tail->samples_num >= n->max_samples)
+    pthread_cond_signal(&s->cond);
+
+  pthread_mutex_unlock(&s->lock);
+  return 0;
+} /* }}} int wpr_shard_enqueue */
+
+static void wpr_node_stop(wpr_node_t *n) /* {{{ */
+{
+  for (size_t i = 0; i < n->shards_num; i++) {
+    wpr_shard_t *s = n->shards + i;
+    pthread_mutex_lock(&s->lock);
+    s->shutdown = true;
+    pthread_cond_broadcast(&s->cond);
+    pthread_cond_broadcast(&s->space);
+    pthread_mutex_unlock(&s->lock);
+  }
+
+  for (size_t i = 0; i < n->shards_num; i++) {
+    wpr_shard_t *s = n->shards + i;
+    if (s->thread_running) {
+      pthread_join(s->thread, NULL);
+      s->thread_running = false;
+    }
+    if (s->dropped > 0)
+      WARNING("write_prometheus_remote plugin: \"%s\": Shard %" PRIsz
+              " dropped %" PRIu64 " samples because its queue was full.",
+              n->name, i, s->dropped);
+    s->dropped = 0;
+  }
+} /* }}} void wpr_node_stop */
+
+static void wpr_node_free(void *arg) /* {{{ */
+{
+  wpr_node_t *n = arg;
+  if (n == NULL)
+    return;
+
+  wpr_node_stop(n);
+
+  for (size_t i = 0; (n->shards != NULL) && (i < n->shards_num); i++) {
+    wpr_shard_t *s = n->shards + i;
+    for (size_t j = 0; j < s->batches_size; j++)
+      free(s->batches[j].buffer.data);
+    free(s->batches);
+    if (s->curl != NULL)
+      curl_easy_cleanup(s->curl);
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->cond);
+    pthread_cond_destroy(&s->space);
+  }
+  free(n->shards);
+
+  /* Unlink the node, so that the shutdown callback does not see it. */
+  for (wpr_node_t **p = &nodes; *p != NULL; p = &(*p)->next) {
+    if (*p == n) {
+      *p = n->next;
+      break;
+    }
+  }
+
+  curl_slist_free_all(n->headers);
+  sfree(n->name);
+  sfree(n->url);
+  sfree(n->user);
+  sfree(n->pass);
+  sfree(n->cacert);
+  sfree(n);
+} /* }}} void wpr_node_free */
+
+static int wpr_write_batch(write_batch_entry_t const *entries,
+                           size_t entries_num,
+                           user_data_t *user_data) /* {{{ */
+{
+  wpr_node_t *n = user_data->data;
+  uint8_t buffer[WPR_SERIES_MAX];
+  int status = 0;
+
+  if (!n->started)
+    return -1;
+
+  for (size_t i = 0; i < entries_num; i++) {
+    data_set_t const *ds = entries[i].ds;
+    value_list_t const *vl = entries[i].vl;
+
+    for (size_t j = 0; j < ds->ds_num; j++) {
+      uint64_t hash = 0;
+      size_t len = encode_series(buffer, ds, vl, j, &hash);
+
+      int tmp = wpr_shard_enqueue(n->shards + (hash % n->shards_num), buffer,
+                                  len);
+      if (tmp != 0)
+        status = tmp;
+    }
+  }
+
+  return status;
+} /* }}} int wpr_write_batch */
+
+static int wpr_node_start(wpr_node_t *n) /* {{{ */
+{
+  size_t batches = (n->capacity + n->max_samples - 1) / n->max_samples;
+  if (batches < 2)
+    batches = 2;
+
+  for (size_t i = 0; i < n->shards_num; i++) {
+    wpr_shard_t *s = n->shards + i;
+    s->node = n;
+    s->index = i;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    pthread_cond_init(&s->space, NULL);
+    C_COMPLAIN_INIT(&s->overflow_complaint);
+    C_COMPLAIN_INIT(&s->complaint);
+
+    s->batches = calloc(batches, sizeof(*s->batches));
+    if (s->batches == NULL)
+      return ENOMEM;
+    s->batches_size = batches;
+
+    if (wpr_curl_init(s) != 0) {
+      ERROR("write_prometheus_remote plugin: curl_easy_init failed.");
+      return -1;
+    }
+  }
+
+  for (size_t i = 0; i < n->shards_num; i++) {
+    wpr_shard_t *s = n->shards + i;
+    char name[32];
+    snprintf(name, sizeof(name), "prom_rw#%" PRIsz, i);
+
+    int status = plugin_thread_create(&s->thread, wpr_shard_thread, s, name);
+    if (status != 0) {
+      ERROR("write_prometheus_remote plugin: Starting a thread failed: %s",
+            STRERROR(status));
+      return status;
+    }
+    s->thread_running = true;
+  }
+
+  n->started = true;
+  return 0;
+} /* }}} int wpr_node_start */
+
+static int wpr_config_header(wpr_node_t *n, oconfig_item_t *ci) /* {{{ */
+{
+  char *header = NULL;
+  int status = cf_util_get_string(ci, &header);
+  if (status != 0)
+    return status;
+
+  struct curl_slist *tmp = curl_slist_append(n->headers, header);
+  sfree(header);
+  if (tmp == NULL)
+    return ENOMEM;
+  n->headers = tmp;
+  return 0;
+} /* }}} int wpr_config_header */
+
+static int wpr_config_size(oconfig_item_t *ci, size_t *ret) /* {{{ */
+{
+  int tmp = 0;
+  int status = cf_util_get_int(ci, &tmp);
+  if (status != 0)
+    return status;
+  if (tmp < 1) {
+    ERROR("write_prometheus_remote plugin: %s must be positive.", ci->key);
+    return EINVAL;
+  }
+  *ret = (size_t)tmp;
+  return 0;
+} /* }}} int wpr_config_size */
+
+static int wpr_config_node(oconfig_item_t *ci) /* {{{ */
+{
+  wpr_node_t *n = calloc(1, sizeof(*n));
+  if (n == NULL)
+    return ENOMEM;
+
+  n->verify_peer = true;
+  n->verify_host = true;
+  n->timeout = TIME_T_TO_CDTIME_T(30);
+  n->shards_num = WPR_DEFAULT_SHARDS;
+  n->capacity = 10000;
+  n->max_samples = 2000;
+  n->deadline = TIME_T_TO_CDTIME_T(5);
+  n->min_backoff = MS_TO_CDTIME_T(30);
+  n->max_backoff = TIME_T_TO_CDTIME_T(5);
+  n->enqueue_timeout = TIME_T_TO_CDTIME_T(10);
+
+  int status = cf_util_get_string(ci, &n->name);
+  for (int i = 0; (status == 0) && (i < ci->children_num); i++) {
+    oconfig_item_t *child = ci->children + i;
+
+    if (strcasecmp("URL", child->key) == 0)
+      status = cf_util_get_string(child, &n->url);
+    else if (strcasecmp("User", child->key) == 0)
+      status = cf_util_get_string(child, &n->user);
+    else if (strcasecmp("Password", child->key) == 0)
+      status = cf_util_get_string(child, &n->pass);
+    else if (strcasecmp("VerifyPeer", child->key) == 0)
+      status = cf_util_get_boolean(child, &n->verify_peer);
+    else if (strcasecmp("VerifyHost", child->key) == 0)
+      status = cf_util_get_boolean(child, &n->verify_host);
+    else if (strcasecmp("CACert", child->key) == 0)
+      status = cf_util_get_string(child, &n->cacert);
+    else if (strcasecmp("Header", child->key) == 0)
+      status = wpr_config_header(n, child);
+    else if (strcasecmp("Timeout", child->key) == 0)
+      status = cf_util_get_cdtime(child, &n->timeout);
+    else if (strcasecmp("Shards", child->key) == 0)
+      status = wpr_config_size(child, &n->shards_num);
+    else if (strcasecmp("Capacity", child->key) == 0)
+      status = wpr_config_size(child, &n->capacity);
+    else if (strcasecmp("MaxSamplesPerSend", child->key) == 0)
+      status = wpr_config_size(child, &n->max_samples);
+    else if (strcasecmp("BatchSendDeadline", child->key) == 0)
+      status = cf_util_get_cdtime(child, &n->deadline);
+    else if (strcasecmp("MinBackoff", child->key) == 0)
+      status = cf_util_get_cdtime(child, &n->min_backoff);
+    else if (strcasecmp("MaxBackoff", child->key) == 0)
+      status = cf_util_get_cdtime(child, &n->max_backoff);
+    else if (strcasecmp("EnqueueTimeout", child->key) == 0)
+      status = cf_util_get_cdtime(child, &n->enqueue_timeout);
+    else {
+      ERROR("write_prometheus_remote plugin: Invalid configuration option: "
+            "%s.",
+            child->key);
+      status = EINVAL;
+    }
+  }
+
+  if ((status == 0) && (n->url == NULL)) {
+    ERROR("write_prometheus_remote plugin: No URL defined for \"%s\".",
+          n->name);
+    status = EINVAL;
+  }
+  if ((status == 0) && (n->shards_num > WPR_SHARDS_MAX)) {
+    ERROR("write_prometheus_remote plugin: Shards must not be larger than "
+          "%d.",
+          WPR_SHARDS_MAX);
+    status = EINVAL;
+  }
+  if ((status == 0) && (n->min_backoff == 0)) {
+    ERROR("write_prometheus_remote plugin: MinBackoff must be positive.");
+    status = EINVAL;
+  }
+  if ((status == 0) && (n->max_backoff < n->min_backoff))
+    n->max_backoff = n->min_backoff;
+
+  char const *const headers[] = {
+      "Content-Type: application/x-protobuf",
+      "Content-Encoding: snappy",
+      "X-Prometheus-Remote-Write-Version: 0.1.0",
+      "Expect:",
+  };
+  for (size_t i = 0; (status == 0) && (i < STATIC_ARRAY_SIZE(headers)); i++) {
+    struct curl_slist *tmp = curl_slist_append(n->headers, headers[i]);
+    if (tmp == NULL)
+      status = ENOMEM;
+    else
+      n->headers = tmp;
+  }
+
+  if (status == 0) {
+    n->shards = calloc(n->shards_num, sizeof(*n->shards));
+    if (n->shards == NULL)
+      status = ENOMEM;
+  }
+
+  if (status != 0) {
+    wpr_node_free(n);
+    return status;
+  }
+
+  n->next = nodes;
+  nodes = n;
+
+  char callback_name[DATA_MAX_NAME_LEN];
+  snprintf(callback_name, sizeof(callback_name),
+           "write_prometheus_remote/%s", n->name);
+  return plugin_register_write_batch(callback_name, wpr_write_batch,
+                                     /* batch_size = */ 0, /* max_age = */ 0,
+                                     &(user_data_t){
+                                         .data = n,
+                                         .free_func = wpr_node_free,
+                                     });
+} /* }}} int wpr_config_node */
+
+static int wpr_config(oconfig_item_t *ci) /* {{{ */
+{
+  for (int i = 0; i < ci->children_num; i++) {
+    oconfig_item_t *child = ci->children + i;
+
+    if (strcasecmp("Node", child->key) == 0) {
+      int status = wpr_config_node(child);
+      if (status != 0)
+        return status;
+    } else {
+      ERROR("write_prometheus_remote plugin: Invalid configuration option: "
+            "%s.",
+            child->key);
+      return EINVAL;
+    }
+  }
+
+  return 0;
+} /* }}} int wpr_config */
+
+static int wpr_init(void) /* {{{ */
+{
+  /* Call this while collectd is still single-threaded to avoid
+   * initialization issues in libgcrypt. */
+  curl_global_init(CURL_GLOBAL_SSL);
+
+  for (wpr_node_t *n = nodes; n != NULL; n = n->next) {
+    int status = wpr_node_start(n);
+    if (status != 0) {
+      ERROR("write_prometheus_remote plugin: Starting \"%s\" failed.",
+            n->name);
+      return status;
+    }
+  }
+  return 0;
+} /* }}} int wpr_init */
+
+/* The write threads have been stopped by now: send what is queued. */
+static int wpr_shutdown(void) /* {{{ */
+{
+  for (wpr_node_t *n = nodes; n != NULL; n = n->next)
+    wpr_node_stop(n);
+  return 0;
+} /* }}} int wpr_shutdown */
+
+void module_register(void) {
+  plugin_register_complex_config("write_prometheus_remote", wpr_config);
+  plugin_register_init("write_prometheus_remote", wpr_init);
+  plugin_register_shutdown("write_prometheus_remote", wpr_shutdown);
+} /* void module_register */
@@ -27,6 +27,7 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 
 #include <hiredis/hiredis.h>
@@ -47,15 +48,186 @@ struct wr_node_s {
   int max_set_size;
   int max_set_duration;
   bool store_rates;
+  int batch_size;
+  cdtime_t batch_timeout;
+  cdtime_t trim_interval;
 
   redisContext *conn;
   pthread_mutex_t lock;
+
+  /* Pipelining state. Commands are queued with redisAppendCommand() and the
+   * replies are read in one go by wr_flush_nolock(). */
+  int pending_replies;
+  int pending_values;
+  cdtime_t batch_start;
+
+  /* Maps a key to a wr_key_t. Used to issue SADD only once per metric and
+   * connection and to rate-limit the trim commands. Keys that are no longer
+   * written are dropped by wr_keys_prune() once per interval. */
+  c_avl_tree_t *keys;
+  cdtime_t next_prune;
 };
 typedef struct wr_node_s wr_node_t;
 
+struct wr_key_s {
+  cdtime_t last_trim;
+  /* The key is forgotten if it is not written to until then. */
+  cdtime_t expire;
+};
+typedef struct wr_key_s wr_key_t;
+
 /*
  * Functions
  */
+static void wr_keys_clear(wr_node_t *node) /* {{{ */
+{
+  void *key;
+  void *value;
+
+  if (node->keys == NULL)
+    return;
+
+  while (c_avl_pick(node->keys, &key, &value) == 0) {
+    sfree(key);
+    sfree(value);
+  }
+} /* }}} void wr_keys_clear */
+
+/* Removes the keys whose metrics have not been written since they expired. */
+static void wr_keys_prune(wr_node_t *node, cdtime_t now) /* {{{ */
+{
+  c_avl_iterator_t *iter;
+  char **expired = NULL;
+  size_t expired_num = 0;
+  char *key;
+  wr_key_t *k;
+
+  if (now < node->next_prune)
+    return;
+  node->next_prune = now + plugin_get_interval();
+
+  iter = c_avl_get_iterator(node->keys);
+  while (c_avl_iterator_next(iter, (void *)&key, (void *)&k) == 0) {
+    if (now < k->expire)
+      continue;
+
+    char **tmp = realloc(expired, (expired_num + 1) * sizeof(*expired));
+    if (tmp == NULL)
+      break;
+    expired = tmp;
+    expired[expired_num++] = key;
+  }
+  c_avl_iterator_destroy(iter);
+
+  for (size_t i = 0; i < expired_num; i++) {
+    if (c_avl_remove(node->keys, expired[i], (void *)&key, (void *)&k) != 0)
+      continue;
+    sfree(key);
+    sfree(k);
+  }
+  sfree(expired);
+} /* }}} void wr_keys_prune */
+
+static void wr_disconnect_nolock(wr_node_t *node) /* {{{ */
+{
+  if (node->conn != NULL) {
+    redisFree(node->conn);
+    node->conn = NULL;
+  }
+
+  node->pending_replies = 0;
+  node->pending_values = 0;
+
+  /* A new connection may point to a server which has lost its data, e.g.
+   * after a restart. Forget which metrics have been registered. */
+  wr_keys_clear(node);
+} /* }}} void wr_disconnect_nolock */
+
+static int wr_connect_nolock(wr_node_t *node) /* {{{ */
+{
+  if (node->conn != NULL)
+    return 0;
+
+  node->conn =
+      redisConnectWithTimeout((char *)node->host, node->port, node->timeout);
+  if (node->conn == NULL) {
+    ERROR("write_redis plugin: Connecting to host \"%s\" (port %i) failed: "
+          "Unknown reason",
+          (node->host != NULL) ? node->host : "localhost",
+          (node->port != 0) ? node->port : 6379);
+    return -1;
+  } else if (node->conn->err) {
+    ERROR("write_redis plugin: Connecting to host \"%s\" (port %i) failed: %s",
+          (node->host != NULL) ? node->host : "localhost",
+          (node->port != 0) ? node->port : 6379, node->conn->errstr);
+    wr_disconnect_nolock(node);
+    return -1;
+  }
+
+  if (redisAppendCommand(node->conn, "SELECT %d", node->database) ==
+      REDIS_OK)
+    node->pending_replies++;
+  else
+    WARNING("SELECT command error. database:%d message:%s", node->database,
+            node->conn->errstr);
+
+  return 0;
+} /* }}} int wr_connect_nolock */
+
+/* Sends all queued commands and reads their replies. */
+static int wr_flush_nolock(wr_node_t *node) /* {{{ */
+{
+  int errors = 0;
+
+  if (node->conn == NULL || node->pending_replies == 0) {
+    node->pending_values = 0;
+    return 0;
+  }
+
+  while (node->pending_replies > 0) {
+    redisReply *rr = NULL;
+
+    if (redisGetReply(node->conn, (void **)&rr) != REDIS_OK) {
+      ERROR("write_redis plugin: node %s: Sending %d command(s) failed: %s",
+            node->name, node->pending_replies, node->conn->errstr);
+      wr_disconnect_nolock(node);
+      return -1;
+    }
+    node->pending_replies--;
+
+    if (rr == NULL)
+      continue;
+
+    if (rr->type == REDIS_REPLY_ERROR) {
+      /* Only report the first error of a batch to avoid flooding the log. */
+      if (errors == 0)
+        WARNING("write_redis plugin: node %s: Command failed: %s", node->name,
+                rr->str);
+      errors++;
+    }
+    freeReplyObject(rr);
+  }
+
+  node->pending_values = 0;
+  wr_keys_prune(node, cdtime());
+  return (errors == 0) ? 0 : -1;
+} /* }}} int wr_flush_nolock */
+
+/* Returns true if the trim commands should be sent for "key" at time "now". */
+static bool wr_trim_due(wr_node_t *node, wr_key_t *k, cdtime_t now) /* {{{ */
+{
+  if (node->max_set_size < 0 && node->max_set_duration <= 0)
+    return false;
+
+  if (node->trim_interval == 0)
+    return true;
+
+  if (k != NULL && (now - k->last_trim) < node->trim_interval)
+    return false;
+
+  return true;
+} /* }}} bool wr_trim_due */
+
 static int wr_write(const data_set_t *ds, /* {{{ */
                     const value_list_t *vl, user_data_t *ud) {
   wr_node_t *node = ud->data;
@@ -66,7 +238,9 @@ static int wr_write(const data_set_t *ds, /* {{{ */
   size_t value_size;
   char *value_ptr;
   int status;
-  redisReply *rr;
+  wr_key_t *k = NULL;
+  bool new_key;
+  cdtime_t now;
 
   status = FORMAT_VL(ident, sizeof(ident), vl);
   if (status != 0)
@@ -82,82 +256,113 @@ static int wr_write(const data_set_t *ds, /* {{{ */
   if (status != 0)
     return status;
 
-  pthread_mutex_lock(&node->lock);
+  now = cdtime();
 
-  if (node->conn == NULL) {
-    node->conn =
-        redisConnectWithTimeout((char *)node->host, node->port, node->timeout);
-    if (node->conn == NULL) {
-      ERROR("write_redis plugin: Connecting to host \"%s\" (port %i) failed: "
-            "Unknown reason",
-            (node->host != NULL) ? node->host : "localhost",
-            (node->port != 0) ? node->port : 6379);
-      pthread_mutex_unlock(&node->lock);
-      return -1;
-    } else if (node->conn->err) {
-      ERROR(
-          "write_redis plugin: Connecting to host \"%s\" (port %i) failed: %s",
-          (node->host != NULL) ? node->host : "localhost",
-          (node->port != 0) ? node->port : 6379, node->conn->errstr);
-      pthread_mutex_unlock(&node->lock);
-      return -1;
-    }
+  pthread_mutex_lock(&node->lock);
 
-    rr = redisCommand(node->conn, "SELECT %d", node->database);
-    if (rr == NULL)
-      WARNING("SELECT command error. database:%d message:%s", node->database,
-              node->conn->errstr);
-    else
-      freeReplyObject(rr);
+  if (wr_connect_nolock(node) != 0) {
+    pthread_mutex_unlock(&node->lock);
+    return -1;
   }
 
-  rr = redisCommand(node->conn, "ZADD %s %s %s", key, time, value);
-  if (rr == NULL)
-    WARNING("ZADD command error. key:%s message:%s", key, node->conn->errstr);
+  new_key = (c_avl_get(node->keys, key, (void *)&k) != 0);
+
+  if (redisAppendCommand(node->conn, "ZADD %s %s %s", key, time, value) ==
+      REDIS_OK)
+    node->pending_replies++;
   else
-    freeReplyObject(rr);
+    WARNING("ZADD command error. key:%s message:%s", key, node->conn->errstr);
 
-  if (node->max_set_size >= 0) {
-    rr = redisCommand(node->conn, "ZREMRANGEBYRANK %s %d %d", key, 0,
-                      (-1 * node->max_set_size) - 1);
-    if (rr == NULL)
-      WARNING("ZREMRANGEBYRANK command error. key:%s message:%s", key,
-              node->conn->errstr);
-    else
-      freeReplyObject(rr);
+  if (wr_trim_due(node, k, now)) {
+    if (node->max_set_size >= 0) {
+      if (redisAppendCommand(node->conn, "ZREMRANGEBYRANK %s %d %d", key, 0,
+                             (-1 * node->max_set_size) - 1) == REDIS_OK)
+        node->pending_replies++;
+      else
+        WARNING("ZREMRANGEBYRANK command error. key:%s message:%s", key,
+                node->conn->errstr);
+    }
+
+    if (node->max_set_duration > 0) {
+      /*
+       * remove element, scored less than 'current-max_set_duration'
+       * '(...' indicates 'less than' in redis CLI.
+       */
+      if (redisAppendCommand(
+              node->conn, "ZREMRANGEBYSCORE %s -1 (%.9f", key,
+              (CDTIME_T_TO_DOUBLE(vl->time) - node->max_set_duration)) ==
+          REDIS_OK)
+        node->pending_replies++;
+      else
+        WARNING("ZREMRANGEBYSCORE command error. key:%s message:%s", key,
+                node->conn->errstr);
+    }
+
+    if (k != NULL)
+      k->last_trim = now;
   }
 
-  if (node->max_set_duration > 0) {
-    /*
-     * remove element, scored less than 'current-max_set_duration'
-     * '(...' indicates 'less than' in redis CLI.
-     */
-    rr = redisCommand(node->conn, "ZREMRANGEBYSCORE %s -1 (%.9f", key,
-                      (CDTIME_T_TO_DOUBLE(vl->time) - node->max_set_duration));
-    if (rr == NULL)
-      WARNING("ZREMRANGEBYSCORE command error. key:%s message:%s", key,
-              node->conn->errstr);
+  /* The set of identifiers only needs to be updated once per metric and
+   * connection. */
+  if (new_key) {
+    if (redisAppendCommand(node->conn, "SADD %svalues %s",
+                           (node->prefix != NULL) ? node->prefix
+                                                  : REDIS_DEFAULT_PREFIX,
+                           ident) == REDIS_OK)
+      node->pending_replies++;
     else
-      freeReplyObject(rr);
+      WARNING("SADD command error. ident:%s message:%s", ident,
+              node->conn->errstr);
+
+    char *key_copy = strdup(key);
+    k = calloc(1, sizeof(*k));
+    if (key_copy == NULL || k == NULL ||
+        c_avl_insert(node->keys, key_copy, k) != 0) {
+      sfree(key_copy);
+      sfree(k);
+    } else {
+      k->last_trim = now;
+    }
   }
 
-  /* TODO(octo): This is more overhead than necessary. Use the cache and
-   * metadata to determine if it is a new metric and call SADD only once for
-   * each metric. */
-  rr = redisCommand(
-      node->conn, "SADD %svalues %s",
-      (node->prefix != NULL) ? node->prefix : REDIS_DEFAULT_PREFIX, ident);
-  if (rr == NULL)
-    WARNING("SADD command error. ident:%s message:%s", ident,
-            node->conn->errstr);
-  else
-    freeReplyObject(rr);
+  /* Like the value cache, forget metrics that missed timeout_g intervals,
+   * but not before their trim interval has passed. */
+  if (k != NULL) {
+    cdtime_t timeout = vl->interval * timeout_g;
+    if (timeout < node->trim_interval)
+      timeout = node->trim_interval;
+    k->expire = now + timeout;
+  }
+
+  if (node->pending_values == 0)
+    node->batch_start = now;
+  node->pending_values++;
+
+  status = 0;
+  if (node->pending_values >= node->batch_size ||
+      (now - node->batch_start) >= node->batch_timeout)
+    status = wr_flush_nolock(node);
 
   pthread_mutex_unlock(&node->lock);
 
-  return 0;
+  return status;
 } /* }}} int wr_write */
 
+static int wr_flush(cdtime_t timeout, /* {{{ */
+                    __attribute__((unused)) const char *identifier,
+                    user_data_t *ud) {
+  wr_node_t *node = ud->data;
+  int status = 0;
+
+  pthread_mutex_lock(&node->lock);
+  if (node->pending_values > 0 &&
+      (timeout == 0 || (cdtime() - node->batch_start) >= timeout))
+    status = wr_flush_nolock(node);
+  pthread_mutex_unlock(&node->lock);
+
+  return status;
+} /* }}} int wr_flush */
+
 static void wr_config_free(void *ptr) /* {{{ */
 {
   wr_node_t *node = ptr;
@@ -165,12 +370,15 @@ static void wr_config_free(void *ptr) /* {{{ */
   if (node == NULL)
     return;
 
-  if (node->conn != NULL) {
-    redisFree(node->conn);
-    node->conn = NULL;
-  }
+  wr_flush_nolock(node);
+  wr_disconnect_nolock(node);
 
+  if (node->keys != NULL)
+    c_avl_destroy(node->keys);
+
+  pthread_mutex_destroy(&node->lock);
   sfree(node->host);
+  sfree(node->prefix);
   sfree(node);
 } /* }}} void wr_config_free */
 
@@ -193,11 +401,19 @@ static int wr_config_node(oconfig_item_t *ci) /* {{{ */
   node->max_set_size = -1;
   node->max_set_duration = -1;
   node->store_rates = true;
+  node->batch_size = 1;
+  node->batch_timeout = TIME_T_TO_CDTIME_T(1);
+  node->trim_interval = 0;
+  node->keys = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (node->keys == NULL) {
+    sfree(node);
+    return ENOMEM;
+  }
   pthread_mutex_init(&node->lock, /* attr = */ NULL);
 
   status = cf_util_get_string_buffer(ci, node->name, sizeof(node->name));
   if (status != 0) {
-    sfree(node);
+    wr_config_free(node);
     return status;
   }
 
@@ -229,6 +445,17 @@ static int wr_config_node(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_int(child, &node->max_set_duration);
     } else if (strcasecmp("StoreRates", child->key) == 0) {
       status = cf_util_get_boolean(child, &node->store_rates);
+    } else if (strcasecmp("BatchSize", child->key) == 0) {
+      status = cf_util_get_int(child, &node->batch_size);
+      if (status == 0 && node->batch_size < 1) {
+        ERROR("write_redis plugin: node %s: BatchSize must be at least 1.",
+              node->name);
+        status = -1;
+      }
+    } else if (strcasecmp("BatchTimeout", child->key) == 0) {
+      status = cf_util_get_cdtime(child, &node->batch_timeout);
+    } else if (strcasecmp("TrimInterval", child->key) == 0) {
+      status = cf_util_get_cdtime(child, &node->trim_interval);
     } else
       WARNING("write_redis plugin: Ignoring unknown config option \"%s\".",
               child->key);
@@ -247,6 +474,11 @@ static int wr_config_node(oconfig_item_t *ci) /* {{{ */
                                        .data = node,
                                        .free_func = wr_config_free,
                                    });
+    if (status == 0)
+      plugin_register_flush(cb_name, wr_flush,
+                            &(user_data_t){
+                                .data = node,
+                            });
   }
 
   if (status != 0)
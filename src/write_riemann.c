@@ -42,6 +42,16 @@
 #define RIEMANN_PORT 5555
 #define RIEMANN_TTL_FACTOR 2.0
 #define RIEMANN_BATCH_MAX 8192
+#define RIEMANN_QUEUE_SIZE 4194304
+#define RIEMANN_RETRY_INTERVAL TIME_T_TO_CDTIME_T(1)
+
+/* A batch waiting to be sent by the sender thread. */
+struct wrr_batch_s {
+  riemann_message_t *msg;
+  size_t size;
+  struct wrr_batch_s *next;
+};
+typedef struct wrr_batch_s wrr_batch_t;
 
 struct riemann_host {
   c_complain_t init_complaint;
@@ -62,11 +72,27 @@ struct riemann_host {
   int batch_max;
   int batch_timeout;
   int reference_count;
-  riemann_message_t *batch_msg;
   char *tls_ca_file;
   char *tls_cert_file;
   char *tls_key_file;
   struct timeval timeout;
+
+  /* Batch mode: the write callback appends events to "batch_msg". Full
+   * batches are moved to the queue, which is drained by the sender thread, so
+   * that a slow server doesn't block the write threads. All of these are
+   * protected by "queue_lock"; "lock" only protects the connection. */
+  pthread_mutex_t queue_lock;
+  pthread_cond_t queue_cond;
+  riemann_message_t *batch_msg;
+  size_t batch_size;
+  wrr_batch_t *queue_head;
+  wrr_batch_t *queue_tail;
+  size_t queue_size;
+  int queue_limit;
+  c_complain_t queue_complaint;
+  pthread_t sender_thread;
+  bool sender_running;
+  bool sender_shutdown;
 };
 
 static char **riemann_tags;
@@ -423,7 +449,8 @@ wrr_value_list_to_message(struct riemann_host const *host, /* {{{ */
                           int *statuses) {
   riemann_message_t *msg;
   size_t i;
-  gauge_t *rates = NULL;
+  gauge_t const *rates = NULL;
+  gauge_t *rates_alloc = NULL;
 
   /* Initialize the Msg structure. */
   msg = riemann_message_new();
@@ -433,7 +460,7 @@ wrr_value_list_to_message(struct riemann_host const *host, /* {{{ */
   }
 
   if (host->store_rates) {
-    rates = uc_get_rate(ds, vl);
+    rates = uc_get_rate_attached(ds, vl, &rates_alloc);
     if (rates == NULL) {
       ERROR("write_riemann plugin: uc_get_rate failed.");
       riemann_message_free(msg);
@@ -447,59 +474,183 @@ wrr_value_list_to_message(struct riemann_host const *host, /* {{{ */
     event = wrr_value_to_event(host, ds, vl, (int)i, rates, statuses[i]);
     if (event == NULL) {
       riemann_message_free(msg);
-      sfree(rates);
+      sfree(rates_alloc);
       return NULL;
     }
     riemann_message_append_events(msg, event, NULL);
   }
 
-  sfree(rates);
+  sfree(rates_alloc);
   return msg;
 } /* }}} riemann_message_t *wrr_value_list_to_message */
 
-/*
- * Always call while holding host->lock !
- */
-static int wrr_batch_flush_nolock(cdtime_t timeout, struct riemann_host *host) {
-  cdtime_t now;
-  int status = 0;
+static void wrr_batch_free(wrr_batch_t *b) /* {{{ */
+{
+  if (b == NULL)
+    return;
 
-  now = cdtime();
-  if (timeout > 0) {
-    if ((host->batch_init + timeout) > now) {
-      return status;
-    }
+  riemann_message_free(b->msg);
+  sfree(b);
+} /* }}} void wrr_batch_free */
+
+/* Moves the current batch to the send queue, dropping the oldest queued
+ * batches if the queue grows beyond its limit. host->queue_lock must be
+ * held. */
+static int wrr_batch_seal_nolock(struct riemann_host *host) /* {{{ */
+{
+  wrr_batch_t *b;
+  size_t dropped = 0;
+
+  if (host->batch_msg == NULL)
+    return 0;
+
+  b = calloc(1, sizeof(*b));
+  if (b == NULL) {
+    ERROR("write_riemann plugin: calloc failed.");
+    return ENOMEM;
   }
-  wrr_send_nolock(host, host->batch_msg);
-  riemann_message_free(host->batch_msg);
+  b->msg = host->batch_msg;
+  b->size = host->batch_size;
 
-  host->batch_init = now;
   host->batch_msg = NULL;
-  return status;
-}
+  host->batch_size = 0;
+
+  if (host->queue_tail == NULL)
+    host->queue_head = b;
+  else
+    host->queue_tail->next = b;
+  host->queue_tail = b;
+  host->queue_size += b->size;
+
+  while (host->queue_head != host->queue_tail &&
+         host->queue_size > (size_t)host->queue_limit) {
+    wrr_batch_t *old = host->queue_head;
+
+    host->queue_head = old->next;
+    host->queue_size -= old->size;
+    dropped += old->msg->n_events;
+    wrr_batch_free(old);
+  }
+
+  if (dropped > 0)
+    c_complain(LOG_WARNING, &host->queue_complaint,
+               "write_riemann plugin: Send queue for \"%s\" is full, "
+               "dropped %" PRIsz " event(s).",
+               host->name, dropped);
+
+  pthread_cond_signal(&host->queue_cond);
+  return 0;
+} /* }}} int wrr_batch_seal_nolock */
+
+static void *wrr_sender_thread(void *arg) /* {{{ */
+{
+  struct riemann_host *host = arg;
+  cdtime_t timeout = TIME_T_TO_CDTIME_T((time_t)host->batch_timeout);
+
+  pthread_mutex_lock(&host->queue_lock);
+  while (true) {
+    if (host->batch_msg != NULL && host->batch_timeout > 0 &&
+        (cdtime() - host->batch_init) >= timeout)
+      wrr_batch_seal_nolock(host);
+
+    if (host->queue_head == NULL) {
+      if (host->sender_shutdown)
+        break;
+
+      if (host->batch_msg != NULL && host->batch_timeout > 0) {
+        struct timespec ts =
+            CDTIME_T_TO_TIMESPEC(host->batch_init + timeout);
+        pthread_cond_timedwait(&host->queue_cond, &host->queue_lock, &ts);
+      } else {
+        pthread_cond_wait(&host->queue_cond, &host->queue_lock);
+      }
+      continue;
+    }
+
+    wrr_batch_t *b = host->queue_head;
+    host->queue_head = b->next;
+    if (host->queue_head == NULL)
+      host->queue_tail = NULL;
+    host->queue_size -= b->size;
+    b->next = NULL;
+    pthread_mutex_unlock(&host->queue_lock);
+
+    int status = wrr_send(host, b->msg);
+
+    pthread_mutex_lock(&host->queue_lock);
+    if (status == 0) {
+      c_release(LOG_INFO, &host->init_complaint,
+                "write_riemann plugin: batch sent.");
+      wrr_batch_free(b);
+      continue;
+    }
+
+    c_complain(LOG_ERR, &host->init_complaint,
+               "write_riemann plugin: riemann_client_send failed with "
+               "status %i",
+               status);
+
+    if (host->sender_shutdown) {
+      /* Don't retry on shutdown: drop everything that is left. */
+      wrr_batch_free(b);
+      while ((b = host->queue_head) != NULL) {
+        host->queue_head = b->next;
+        wrr_batch_free(b);
+      }
+      host->queue_tail = NULL;
+      host->queue_size = 0;
+      break;
+    }
+
+    /* Put the batch back and retry after a while. The queue limit discards
+     * the oldest data if the server stays unavailable. */
+    b->next = host->queue_head;
+    host->queue_head = b;
+    if (host->queue_tail == NULL)
+      host->queue_tail = b;
+    host->queue_size += b->size;
+
+    struct timespec ts =
+        CDTIME_T_TO_TIMESPEC(cdtime() + RIEMANN_RETRY_INTERVAL);
+    pthread_cond_timedwait(&host->queue_cond, &host->queue_lock, &ts);
+  }
+  pthread_mutex_unlock(&host->queue_lock);
+
+  return NULL;
+} /* }}} void *wrr_sender_thread */
+
+/* Sends the remaining batches and stops the sender thread. */
+static void wrr_sender_stop(struct riemann_host *host) /* {{{ */
+{
+  if (!host->sender_running)
+    return;
+
+  pthread_mutex_lock(&host->queue_lock);
+  host->sender_shutdown = true;
+  wrr_batch_seal_nolock(host);
+  pthread_cond_signal(&host->queue_cond);
+  pthread_mutex_unlock(&host->queue_lock);
+
+  pthread_join(host->sender_thread, NULL);
+  host->sender_running = false;
+} /* }}} void wrr_sender_stop */
 
 static int wrr_batch_flush(cdtime_t timeout,
                            const char *identifier __attribute__((unused)),
                            user_data_t *user_data) {
   struct riemann_host *host;
-  int status;
+  int status = 0;
 
   if (user_data == NULL)
     return -EINVAL;
 
   host = user_data->data;
-  pthread_mutex_lock(&host->lock);
-  status = wrr_batch_flush_nolock(timeout, host);
-  if (status != 0)
-    c_complain(
-        LOG_ERR, &host->init_complaint,
-        "write_riemann plugin: riemann_client_send failed with status %i",
-        status);
-  else
-    c_release(LOG_DEBUG, &host->init_complaint,
-              "write_riemann plugin: batch sent.");
+  pthread_mutex_lock(&host->queue_lock);
+  if (host->batch_msg != NULL &&
+      (timeout == 0 || (host->batch_init + timeout) <= cdtime()))
+    status = wrr_batch_seal_nolock(host);
+  pthread_mutex_unlock(&host->queue_lock);
 
-  pthread_mutex_unlock(&host->lock);
   return status;
 }
 
@@ -508,17 +659,21 @@ static int wrr_batch_add_value_list(struct riemann_host *host, /* {{{ */
                                     value_list_t const *vl, int *statuses) {
   riemann_message_t *msg;
   size_t len;
-  int ret;
-  cdtime_t timeout;
+  int ret = 0;
 
   msg = wrr_value_list_to_message(host, ds, vl, statuses);
   if (msg == NULL)
     return -1;
 
-  pthread_mutex_lock(&host->lock);
+  /* Computing the packed size of the whole batch is linear in the number of
+   * events, so add up the sizes of the individual messages instead. */
+  len = riemann_message_get_packed_size(msg);
+
+  pthread_mutex_lock(&host->queue_lock);
 
   if (host->batch_msg == NULL) {
     host->batch_msg = msg;
+    host->batch_init = cdtime();
   } else {
     int status;
 
@@ -530,24 +685,17 @@ static int wrr_batch_add_value_list(struct riemann_host *host, /* {{{ */
     riemann_message_free(msg);
 
     if (status != 0) {
-      pthread_mutex_unlock(&host->lock);
+      pthread_mutex_unlock(&host->queue_lock);
       ERROR("write_riemann plugin: out of memory");
       return -1;
     }
   }
+  host->batch_size += len;
 
-  len = riemann_message_get_packed_size(host->batch_msg);
-  ret = 0;
-  if ((host->batch_max < 0) || (((size_t)host->batch_max) <= len)) {
-    ret = wrr_batch_flush_nolock(0, host);
-  } else {
-    if (host->batch_timeout > 0) {
-      timeout = TIME_T_TO_CDTIME_T((time_t)host->batch_timeout);
-      ret = wrr_batch_flush_nolock(timeout, host);
-    }
-  }
+  if ((host->batch_max < 0) || (((size_t)host->batch_max) <= host->batch_size))
+    ret = wrr_batch_seal_nolock(host);
 
-  pthread_mutex_unlock(&host->lock);
+  pthread_mutex_unlock(&host->queue_lock);
   return ret;
 } /* }}} riemann_message_t *wrr_batch_add_value_list */
 
@@ -624,10 +772,20 @@ static void wrr_free(void *p) /* {{{ */
     pthread_mutex_unlock(&host->lock);
     return;
   }
+  pthread_mutex_unlock(&host->lock);
 
-  wrr_disconnect(host);
+  /* The sender thread needs host->lock to send the remaining batches. */
+  wrr_sender_stop(host);
 
   pthread_mutex_lock(&host->lock);
+  wrr_disconnect(host);
+  pthread_mutex_unlock(&host->lock);
+
+  if (host->batch_msg != NULL)
+    riemann_message_free(host->batch_msg);
+
+  pthread_cond_destroy(&host->queue_cond);
+  pthread_mutex_destroy(&host->queue_lock);
   pthread_mutex_destroy(&host->lock);
   sfree(host);
 } /* }}} void wrr_free */
@@ -645,7 +803,10 @@ static int wrr_config_node(oconfig_item_t *ci) /* {{{ */
     return ENOMEM;
   }
   pthread_mutex_init(&host->lock, NULL);
+  pthread_mutex_init(&host->queue_lock, NULL);
+  pthread_cond_init(&host->queue_cond, NULL);
   C_COMPLAIN_INIT(&host->init_complaint);
+  C_COMPLAIN_INIT(&host->queue_complaint);
   host->reference_count = 1;
   host->node = NULL;
   host->port = 0;
@@ -657,6 +818,7 @@ static int wrr_config_node(oconfig_item_t *ci) /* {{{ */
   host->batch_max = RIEMANN_BATCH_MAX; /* typical MSS */
   host->batch_init = cdtime();
   host->batch_timeout = 0;
+  host->queue_limit = RIEMANN_QUEUE_SIZE;
   host->ttl_factor = RIEMANN_TTL_FACTOR;
   host->client = NULL;
   host->client_type = RIEMANN_CLIENT_TCP;
@@ -706,6 +868,15 @@ static int wrr_config_node(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_int(child, &host->batch_timeout);
       if (status != 0)
         break;
+    } else if (strcasecmp("BatchQueueSize", child->key) == 0) {
+      status = cf_util_get_int(child, &host->queue_limit);
+      if (status != 0)
+        break;
+      if (host->queue_limit < 1) {
+        ERROR("write_riemann plugin: BatchQueueSize must be positive.");
+        status = -1;
+        break;
+      }
     } else if (strcasecmp("Timeout", child->key) == 0) {
 #if RCC_VERSION_NUMBER >= 0x010800
       status = cf_util_get_int(child, (int *)&host->timeout.tv_sec);
@@ -808,6 +979,17 @@ static int wrr_config_node(oconfig_item_t *ci) /* {{{ */
   if (host->client_type != RIEMANN_CLIENT_UDP && host->batch_mode) {
     ud.free_func = NULL;
     plugin_register_flush(callback_name, wrr_batch_flush, &ud);
+    ud.free_func = wrr_free;
+
+    status = plugin_thread_create(&host->sender_thread, wrr_sender_thread,
+                                  host, "write_riemann");
+    if (status != 0) {
+      ERROR("write_riemann plugin: Starting the sender thread failed.");
+      /* Fall back to sending every value list synchronously. */
+      host->batch_mode = false;
+    } else {
+      host->sender_running = true;
+    }
   }
   if (status != 0)
     WARNING("write_riemann plugin: plugin_register_write (\"%s\") "
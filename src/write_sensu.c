@@ -30,17 +30,22 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/tcp_pool/tcp_pool.h"
 #include "utils_cache.h"
 #include <arpa/inet.h>
 #include <errno.h>
 #include <inttypes.h>
-#include <netdb.h>
 #include <stddef.h>
 
 #include <stdlib.h>
 #define SENSU_HOST "localhost"
 #define SENSU_PORT "3030"
 
+/* Messages are collected in buffers of this size when the connection is kept
+ * open. Larger messages get a buffer of their own. */
+#define SENSU_SEND_BUF_SIZE 4096
+#define SENSU_DEFAULT_BACKLOG_SIZE (1024 * 1024)
+
 #ifdef HAVE_ASPRINTF
 #define my_asprintf asprintf
 #define my_vasprintf vasprintf
@@ -104,8 +109,6 @@ struct sensu_host {
   char *event_service_prefix;
   struct str_list metric_handlers;
   struct str_list notification_handlers;
-#define F_READY 0x01
-  uint8_t flags;
   pthread_mutex_t lock;
   bool notifications;
   bool metrics;
@@ -115,8 +118,11 @@ struct sensu_host {
   char *separator;
   char *node;
   char *service;
-  int s;
-  struct addrinfo *res;
+  int connections;
+  bool persistent;
+  cdtime_t resolve_interval;
+  size_t backlog_size;
+  c_tcp_pool_t *pool;
   int reference_count;
 };
 
@@ -154,77 +160,6 @@ static void free_str_list(struct str_list *strs) /* {{{ */
 }
 /* }}} void free_str_list */
 
-static int sensu_connect(struct sensu_host *host) /* {{{ */
-{
-  int e;
-  char const *node;
-  char const *service;
-
-  // Resolve the target if we haven't done already
-  if (!(host->flags & F_READY)) {
-    memset(&service, 0, sizeof(service));
-    host->res = NULL;
-
-    node = (host->node != NULL) ? host->node : SENSU_HOST;
-    service = (host->service != NULL) ? host->service : SENSU_PORT;
-
-    struct addrinfo ai_hints = {.ai_family = AF_INET,
-                                .ai_flags = AI_ADDRCONFIG,
-                                .ai_socktype = SOCK_STREAM};
-
-    if ((e = getaddrinfo(node, service, &ai_hints, &(host->res))) != 0) {
-      ERROR("write_sensu plugin: Unable to resolve host \"%s\": %s", node,
-            gai_strerror(e));
-      return -1;
-    }
-    DEBUG("write_sensu plugin: successfully resolved host/port: %s/%s", node,
-          service);
-    host->flags |= F_READY;
-  }
-
-  struct linger so_linger;
-  host->s = -1;
-  for (struct addrinfo *ai = host->res; ai != NULL; ai = ai->ai_next) {
-    // create the socket
-    if ((host->s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) ==
-        -1) {
-      continue;
-    }
-
-    // Set very low close() lingering
-    so_linger.l_onoff = 1;
-    so_linger.l_linger = 3;
-    if (setsockopt(host->s, SOL_SOCKET, SO_LINGER, &so_linger,
-                   sizeof so_linger) != 0)
-      WARNING("write_sensu plugin: failed to set socket close() lingering");
-
-    set_sock_opts(host->s);
-
-    // connect the socket
-    if (connect(host->s, ai->ai_addr, ai->ai_addrlen) != 0) {
-      close(host->s);
-      host->s = -1;
-      continue;
-    }
-    DEBUG("write_sensu plugin: connected");
-    break;
-  }
-
-  if (host->s < 0) {
-    WARNING("write_sensu plugin: Unable to connect to sensu client");
-    return -1;
-  }
-  return 0;
-} /* }}} int sensu_connect */
-
-static void sensu_close_socket(struct sensu_host *host) /* {{{ */
-{
-  if (host->s != -1)
-    close(host->s);
-  host->s = -1;
-
-} /* }}} void sensu_close_socket */
-
 static char *build_json_str_list(const char *tag,
                                  struct str_list const *list) /* {{{ */
 {
@@ -885,42 +820,38 @@ static char *sensu_notification_to_json(struct sensu_host *host, /* {{{ */
   return ret_str;
 } /* }}} char *sensu_notification_to_json */
 
-static int sensu_send_msg(struct sensu_host *host, const char *msg) /* {{{ */
-{
-  int status = 0;
-  size_t buffer_len;
-
-  status = sensu_connect(host);
-  if (status != 0)
-    return status;
-
-  buffer_len = strlen(msg);
-
-  status = (int)swrite(host->s, msg, buffer_len);
-  sensu_close_socket(host);
-
-  if (status != 0) {
-    ERROR("write_sensu plugin: Sending to Sensu at %s:%s failed: %s",
-          (host->node != NULL) ? host->node : SENSU_HOST,
-          (host->service != NULL) ? host->service : SENSU_PORT, STRERRNO);
-    return -1;
-  }
-
-  return 0;
-} /* }}} int sensu_send_msg */
-
+/* sensu_send queues the message. The connection pool is created on first
+ * use, so its I/O thread is started after the daemon forked. Must hold
+ * host->lock when calling. */
 static int sensu_send(struct sensu_host *host, char const *msg) /* {{{ */
 {
-  int status = 0;
+  char const *node = (host->node != NULL) ? host->node : SENSU_HOST;
+  char const *service = (host->service != NULL) ? host->service : SENSU_PORT;
+
+  if (host->pool == NULL) {
+    host->pool = c_tcp_pool_create(&(c_tcp_pool_options_t){
+        .name = "write_sensu",
+        .servers = &(c_tcp_pool_server_t){.node = node, .service = service},
+        .servers_num = 1,
+        .connections = (size_t)host->connections,
+        .buffer_size = SENSU_SEND_BUF_SIZE,
+        .backlog_size = host->backlog_size,
+        .resolve_interval = host->resolve_interval,
+        .close_after_send = !host->persistent,
+    });
+    if (host->pool == NULL) {
+      ERROR("write_sensu plugin: Creating the connection pool for %s:%s "
+            "failed.",
+            node, service);
+      return -1;
+    }
+  }
 
-  status = sensu_send_msg(host, msg);
+  int status = c_tcp_pool_send(host->pool, msg, strlen(msg));
   if (status != 0) {
-    host->flags &= ~F_READY;
-    if (host->res != NULL) {
-      freeaddrinfo(host->res);
-      host->res = NULL;
-    }
-    return status;
+    ERROR("write_sensu plugin: Queueing data for Sensu at %s:%s failed: %s",
+          node, service, STRERROR(status));
+    return -1;
   }
 
   return 0;
@@ -931,14 +862,15 @@ static int sensu_write(const data_set_t *ds, /* {{{ */
   int status = 0;
   int statuses[vl->values_len];
   struct sensu_host *host = ud->data;
-  gauge_t *rates = NULL;
+  gauge_t const *rates = NULL;
+  gauge_t *rates_alloc = NULL;
   char *msg;
 
   pthread_mutex_lock(&host->lock);
   memset(statuses, 0, vl->values_len * sizeof(*statuses));
 
   if (host->store_rates) {
-    rates = uc_get_rate(ds, vl);
+    rates = uc_get_rate_attached(ds, vl, &rates_alloc);
     if (rates == NULL) {
       ERROR("write_sensu plugin: uc_get_rate failed.");
       pthread_mutex_unlock(&host->lock);
@@ -948,7 +880,7 @@ static int sensu_write(const data_set_t *ds, /* {{{ */
   for (size_t i = 0; i < vl->values_len; i++) {
     msg = sensu_value_to_json(host, ds, vl, (int)i, rates);
     if (msg == NULL) {
-      sfree(rates);
+      sfree(rates_alloc);
       pthread_mutex_unlock(&host->lock);
       return -1;
     }
@@ -957,11 +889,11 @@ static int sensu_write(const data_set_t *ds, /* {{{ */
     if (status != 0) {
       ERROR("write_sensu plugin: sensu_send failed with status %i", status);
       pthread_mutex_unlock(&host->lock);
-      sfree(rates);
+      sfree(rates_alloc);
       return status;
     }
   }
-  sfree(rates);
+  sfree(rates_alloc);
   pthread_mutex_unlock(&host->lock);
   return status;
 } /* }}} int sensu_write */
@@ -1005,11 +937,8 @@ static void sensu_free(void *p) /* {{{ */
     return;
   }
 
-  sensu_close_socket(host);
-  if (host->res != NULL) {
-    freeaddrinfo(host->res);
-    host->res = NULL;
-  }
+  c_tcp_pool_destroy(host->pool);
+  host->pool = NULL;
   sfree(host->service);
   sfree(host->event_service_prefix);
   sfree(host->name);
@@ -1030,6 +959,7 @@ static int sensu_config_node(oconfig_item_t *ci) /* {{{ */
   int status = 0;
   oconfig_item_t *child;
   char callback_name[DATA_MAX_NAME_LEN];
+  double backlog_size = SENSU_DEFAULT_BACKLOG_SIZE;
 
   if ((host = calloc(1, sizeof(*host))) == NULL) {
     ERROR("write_sensu plugin: calloc failed.");
@@ -1044,6 +974,9 @@ static int sensu_config_node(oconfig_item_t *ci) /* {{{ */
   host->store_rates = true;
   host->always_append_ds = false;
   host->include_source = false;
+  host->connections = 1;
+  host->persistent = false;
+  host->resolve_interval = 0;
   host->metric_handlers.nb_strs = 0;
   host->metric_handlers.strs = NULL;
   host->notification_handlers.nb_strs = 0;
@@ -1120,6 +1053,22 @@ static int sensu_config_node(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_boolean(child, &host->include_source);
       if (status != 0)
         break;
+    } else if (strcasecmp("PersistentConnection", child->key) == 0) {
+      status = cf_util_get_boolean(child, &host->persistent);
+      if (status != 0)
+        break;
+    } else if (strcasecmp("Connections", child->key) == 0) {
+      status = cf_util_get_int(child, &host->connections);
+      if (status != 0)
+        break;
+    } else if (strcasecmp("ResolveInterval", child->key) == 0) {
+      status = cf_util_get_cdtime(child, &host->resolve_interval);
+      if (status != 0)
+        break;
+    } else if (strcasecmp("BacklogSize", child->key) == 0) {
+      status = cf_util_get_double(child, &backlog_size);
+      if (status != 0)
+        break;
     } else {
       WARNING("write_sensu plugin: ignoring unknown config "
               "option: \"%s\"",
@@ -1131,6 +1080,20 @@ static int sensu_config_node(oconfig_item_t *ci) /* {{{ */
     return status;
   }
 
+  if (host->connections < 1) {
+    ERROR("write_sensu plugin: Connections must be at least 1.");
+    sensu_free(host);
+    return -1;
+  }
+
+  if (!(backlog_size >= SENSU_SEND_BUF_SIZE)) {
+    ERROR("write_sensu plugin: BacklogSize must be at least %d bytes.",
+          SENSU_SEND_BUF_SIZE);
+    sensu_free(host);
+    return -1;
+  }
+  host->backlog_size = (size_t)backlog_size;
+
   if (host->metrics && (host->metric_handlers.nb_strs == 0)) {
     sensu_free(host);
     WARNING("write_sensu plugin: metrics enabled but no MetricHandler defined. "
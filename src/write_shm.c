@@ -0,0 +1,242 @@
+/**
+ * collectd - src/write_shm.c
+ * Copyright (C) 2026       collectd.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+/*
+ * Publishes the last value and rate of each identifier in a shared memory
+ * segment, so that local readers can look them up with lcc_shm_getval()
+ * instead of asking the unixsock plugin. The layout is described in
+ * src/libcollectdclient/collectd/shm_format.h.
+ */
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils/common/common.h"
+#include "utils/shm/shm.h"
+#include "utils_cache.h"
+#include "utils_complain.h"
+
+#include "collectd/shm_format.h"
+
+#include <sys/stat.h>
+
+#define WSHM_DEFAULT_SLOTS 16384
+
+static char *shm_name;
+static char *shm_group;
+static int shm_perms = S_IRUSR | S_IWUSR | S_IRGRP;
+static int shm_slots = WSHM_DEFAULT_SLOTS;
+
+/* Serializes the writers: each slot's sequence lock supports a single one. */
+static pthread_mutex_t shm_lock = PTHREAD_MUTEX_INITIALIZER;
+static void *shm_addr;
+static size_t shm_size;
+
+static c_complain_t full_complaint = C_COMPLAIN_INIT_STATIC;
+static c_complain_t skip_complaint = C_COMPLAIN_INIT_STATIC;
+
+static char const *wshm_name(void) {
+  return (shm_name != NULL) ? shm_name : LCC_SHM_DEFAULT_NAME;
+}
+
+static lcc_shm_slot_t *wshm_slot(size_t index) {
+  return (lcc_shm_slot_t *)((char *)shm_addr + sizeof(lcc_shm_header_t) +
+                            index * sizeof(lcc_shm_slot_t));
+}
+
+static int wshm_init(void) /* {{{ */
+{
+  if (shm_addr != NULL)
+    return 0;
+
+  size_t size = sizeof(lcc_shm_header_t) +
+                (size_t)shm_slots * sizeof(lcc_shm_slot_t);
+  void *addr =
+      cu_shm_create(wshm_name(), LCC_SHM_MAGIC, size, shm_perms, shm_group);
+  if (addr == NULL)
+    return -1;
+
+  /* ftruncate() zeroed the segment, i.e. all slots are empty. */
+  lcc_shm_header_t *h = addr;
+  h->magic = LCC_SHM_MAGIC;
+  h->version = LCC_SHM_VERSION;
+  h->slots_num = (uint32_t)shm_slots;
+  h->slot_size = (uint32_t)sizeof(lcc_shm_slot_t);
+  __atomic_store_n(&h->state, LCC_SHM_STATE_OPEN, __ATOMIC_RELEASE);
+
+  pthread_mutex_lock(&shm_lock);
+  shm_addr = addr;
+  shm_size = size;
+  pthread_mutex_unlock(&shm_lock);
+
+  INFO("write_shm plugin: Publishing up to %d identifiers in %s (%zu bytes).",
+       shm_slots, wshm_name(), size);
+  return 0;
+} /* }}} int wshm_init */
+
+/* Returns the slot of "name", claiming an empty one if necessary, or NULL if
+ * the table is full. Must be called with shm_lock held. */
+static lcc_shm_slot_t *wshm_lookup(char const *name, uint64_t hash) /* {{{ */
+{
+  for (size_t i = 0; i < (size_t)shm_slots; i++) {
+    lcc_shm_slot_t *slot = wshm_slot((size_t)((hash + i) % shm_slots));
+
+    if (slot->hash == 0) {
+      uint32_t seq = slot->seq;
+      __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+      __atomic_thread_fence(__ATOMIC_RELEASE);
+      sstrncpy(slot->name, name, sizeof(slot->name));
+      __atomic_store_n(&slot->hash, hash, __ATOMIC_RELAXED);
+      __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+      return slot;
+    }
+
+    if ((slot->hash == hash) && (strcmp(slot->name, name) == 0))
+      return slot;
+  }
+
+  return NULL;
+} /* }}} lcc_shm_slot_t *wshm_lookup */
+
+static int wshm_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
+                      __attribute__((unused)) user_data_t *ud) {
+  char name[LCC_SHM_NAME_LEN];
+  if ((ds->ds_num > LCC_SHM_VALUES_MAX) ||
+      (FORMAT_VL(name, sizeof(name), vl) != 0)) {
+    c_complain(LOG_WARNING, &skip_complaint,
+               "write_shm plugin: Skipping values of type \"%s\": either the "
+               "type has more than %d data sources or the identifier is "
+               "longer than %d bytes.",
+               vl->type, LCC_SHM_VALUES_MAX, LCC_SHM_NAME_LEN - 1);
+    return 0;
+  }
+
+  gauge_t *rates_alloc = NULL;
+  gauge_t const *rates = uc_get_rate_attached(ds, vl, &rates_alloc);
+  if (rates == NULL)
+    return -1;
+
+  uint64_t hash = lcc_shm_hash(name);
+
+  pthread_mutex_lock(&shm_lock);
+  if (shm_addr == NULL) {
+    pthread_mutex_unlock(&shm_lock);
+    sfree(rates_alloc);
+    return -1;
+  }
+
+  lcc_shm_slot_t *slot = wshm_lookup(name, hash);
+  if (slot == NULL) {
+    pthread_mutex_unlock(&shm_lock);
+    sfree(rates_alloc);
+    c_complain(LOG_WARNING, &full_complaint,
+               "write_shm plugin: All %d slots are in use, dropping \"%s\". "
+               "Consider increasing \"Slots\".",
+               shm_slots, name);
+    return -1;
+  }
+
+  uint32_t seq = slot->seq;
+  __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  slot->time = CDTIME_T_TO_DOUBLE(vl->time);
+  slot->interval = CDTIME_T_TO_DOUBLE(vl->interval);
+  slot->values_num = (uint32_t)ds->ds_num;
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    slot->values_types[i] = (int32_t)ds->ds[i].type;
+    memcpy(&slot->values[i], &vl->values[i], sizeof(slot->values[i]));
+    slot->rates[i] = rates[i];
+    sstrncpy(slot->values_names[i], ds->ds[i].name,
+             sizeof(slot->values_names[i]));
+  }
+
+  __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&shm_lock);
+
+  c_release(LOG_INFO, &full_complaint,
+            "write_shm plugin: Slots are available again.");
+  sfree(rates_alloc);
+  return 0;
+} /* }}} int wshm_write */
+
+static int wshm_shutdown(void) /* {{{ */
+{
+  pthread_mutex_lock(&shm_lock);
+  if (shm_addr != NULL) {
+    cu_shm_destroy(wshm_name(), shm_addr, shm_size);
+    shm_addr = NULL;
+  }
+  pthread_mutex_unlock(&shm_lock);
+
+  sfree(shm_name);
+  sfree(shm_group);
+  return 0;
+} /* }}} int wshm_shutdown */
+
+static int wshm_config(oconfig_item_t *ci) /* {{{ */
+{
+  for (int i = 0; i < ci->children_num; i++) {
+    oconfig_item_t *child = ci->children + i;
+    int status = 0;
+
+    if (strcasecmp("Name", child->key) == 0) {
+      status = cf_util_get_string(child, &shm_name);
+      if ((status == 0) &&
+          ((shm_name[0] != '/') || (strchr(shm_name + 1, '/') != NULL))) {
+        ERROR("write_shm plugin: Name must start with a slash and contain no "
+              "other slashes.");
+        status = -1;
+      }
+    } else if (strcasecmp("Group", child->key) == 0) {
+      status = cf_util_get_string(child, &shm_group);
+    } else if (strcasecmp("Permissions", child->key) == 0) {
+      char *perms = NULL;
+      status = cf_util_get_string(child, &perms);
+      if (status == 0)
+        shm_perms = (int)strtol(perms, NULL, 8);
+      sfree(perms);
+    } else if (strcasecmp("Slots", child->key) == 0) {
+      status = cf_util_get_int(child, &shm_slots);
+      if ((status == 0) && (shm_slots < 1)) {
+        ERROR("write_shm plugin: Slots must be positive.");
+        status = -1;
+      }
+    } else {
+      ERROR("write_shm plugin: Unknown config option: %s", child->key);
+      status = -1;
+    }
+
+    if (status != 0)
+      return status;
+  }
+
+  return 0;
+} /* }}} int wshm_config */
+
+void module_register(void) {
+  plugin_register_complex_config("write_shm", wshm_config);
+  plugin_register_init("write_shm", wshm_init);
+  plugin_register_write("write_shm", wshm_write, /* user_data = */ NULL);
+  plugin_register_shutdown("write_shm", wshm_shutdown);
+}
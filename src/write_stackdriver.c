@@ -44,12 +44,24 @@
 #define MONITORING_SCOPE "https://www.googleapis.com/auth/monitoring"
 #endif
 
+/* timeSeries.create accepts at most 200 time series per request. */
+#ifndef WG_MAX_BATCH_SIZE
+#define WG_MAX_BATCH_SIZE 200
+#endif
+
+/* curl_multi_poll() and curl_multi_wakeup() were added in 7.68.0. */
+#if LIBCURL_VERSION_NUM >= 0x074400
+#define HAVE_CURL_MULTI_POLL 1
+#endif
+
 struct wg_callback_s {
   /* config */
   char *email;
   char *project;
   char *url;
   sd_resource_t *resource;
+  size_t batch_size;
+  int max_in_flight;
 
   /* runtime */
   oauth_t *auth;
@@ -61,6 +73,24 @@ struct wg_callback_s {
   cdtime_t send_buffer_init_time;
 
   pthread_mutex_t lock;
+
+  /* With max_in_flight > 0, payloads are posted by a sender thread driving
+   * a curl multi handle. The queue and the idle list are protected by
+   * queue_lock; multi, auth_header and auth_time are only used by the
+   * sender thread. */
+  pthread_t io_thread;
+  bool io_thread_running;
+  bool io_stop;
+  pthread_mutex_t queue_lock;
+  pthread_cond_t queue_cond;
+  struct wg_request_s *queue_head;
+  struct wg_request_s *queue_tail;
+  size_t queue_num;
+  size_t in_flight;
+  struct wg_request_s *idle;
+  CURLM *multi;
+  char *auth_header;
+  cdtime_t auth_time;
 };
 typedef struct wg_callback_s wg_callback_t;
 
@@ -70,6 +100,20 @@ struct wg_memory_s {
 };
 typedef struct wg_memory_s wg_memory_t;
 
+/* wg_request_t is a timeSeries.create request handed to the sender thread. */
+struct wg_request_s {
+  wg_callback_t *cb;
+  CURL *curl;
+  char curl_errbuf[CURL_ERROR_SIZE];
+  struct curl_slist *headers;
+
+  char *payload;
+  wg_memory_t response;
+
+  struct wg_request_s *next;
+};
+typedef struct wg_request_s wg_request_t;
+
 static size_t wg_write_memory_cb(void *contents, size_t size,
                                  size_t nmemb, /* {{{ */
                                  void *userp) {
@@ -293,6 +337,338 @@ static int wg_call_timeseries_write(wg_callback_t *cb, char const *payload) {
   return 0;
 } /* int wg_call_timeseries_write */
 
+/*
+ * Asynchronous requests
+ *
+ * wg_flush_nolock hands payloads to the sender thread and returns right
+ * away. The sender thread keeps up to "MaxInFlight" timeSeries.create
+ * requests running in a curl multi handle and fetches the access token
+ * itself, ahead of its expiry, so write threads never wait for the API or
+ * the token endpoint. A full queue blocks the write threads, which bounds
+ * the memory used while the API is slow.
+ * {{{ */
+static void wg_request_destroy(wg_request_t *r) {
+  if (r == NULL)
+    return;
+
+  if (r->curl != NULL)
+    curl_easy_cleanup(r->curl);
+  curl_slist_free_all(r->headers);
+  sfree(r->payload);
+  sfree(r->response.memory);
+  sfree(r);
+} /* void wg_request_destroy */
+
+/* wg_request_get returns an idle request or creates a new one. Must be
+ * called with queue_lock held. */
+static wg_request_t *wg_request_get(wg_callback_t *cb) {
+  wg_request_t *r = cb->idle;
+  if (r != NULL) {
+    cb->idle = r->next;
+    r->next = NULL;
+    return r;
+  }
+
+  r = calloc(1, sizeof(*r));
+  if (r == NULL)
+    return NULL;
+  r->cb = cb;
+
+  r->curl = curl_easy_init();
+  if (r->curl == NULL) {
+    ERROR("write_stackdriver plugin: curl_easy_init failed.");
+    sfree(r);
+    return NULL;
+  }
+
+  curl_easy_setopt(r->curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(r->curl, CURLOPT_USERAGENT,
+                   PACKAGE_NAME "/" PACKAGE_VERSION);
+  curl_easy_setopt(r->curl, CURLOPT_ERRORBUFFER, r->curl_errbuf);
+  curl_easy_setopt(r->curl, CURLOPT_POST, 1L);
+  curl_easy_setopt(r->curl, CURLOPT_WRITEFUNCTION, wg_write_memory_cb);
+  curl_easy_setopt(r->curl, CURLOPT_WRITEDATA, &r->response);
+  curl_easy_setopt(r->curl, CURLOPT_PRIVATE, (void *)r);
+#if LIBCURL_VERSION_NUM >= 0x072b00 /* 7.43.0 */
+  curl_easy_setopt(r->curl, CURLOPT_PIPEWAIT, 1L);
+#endif
+#ifdef CURL_HTTP_VERSION_2TLS
+  curl_easy_setopt(r->curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+#endif
+
+  return r;
+} /* wg_request_t *wg_request_get */
+
+/* wg_request_release resets a request and puts it on the idle list. */
+static void wg_request_release(wg_callback_t *cb, wg_request_t *r) {
+  curl_slist_free_all(r->headers);
+  r->headers = NULL;
+  sfree(r->payload);
+  sfree(r->response.memory);
+  r->response.size = 0;
+
+  pthread_mutex_lock(&cb->queue_lock);
+  r->next = cb->idle;
+  cb->idle = r;
+  cb->in_flight--;
+  pthread_mutex_unlock(&cb->queue_lock);
+} /* void wg_request_release */
+
+/* wg_submit hands payload to the sender thread, which takes ownership. */
+static int wg_submit(wg_callback_t *cb, char *payload) /* {{{ */
+{
+  pthread_mutex_lock(&cb->queue_lock);
+
+  while ((cb->queue_num >= (size_t)cb->max_in_flight) && !cb->io_stop)
+    pthread_cond_wait(&cb->queue_cond, &cb->queue_lock);
+
+  wg_request_t *r = wg_request_get(cb);
+  if (r == NULL) {
+    pthread_mutex_unlock(&cb->queue_lock);
+    ERROR("write_stackdriver plugin: Allocating a request failed.");
+    sfree(payload);
+    return ENOMEM;
+  }
+  r->payload = payload;
+
+  if (cb->queue_tail == NULL)
+    cb->queue_head = r;
+  else
+    cb->queue_tail->next = r;
+  cb->queue_tail = r;
+  cb->queue_num++;
+
+#if HAVE_CURL_MULTI_POLL
+  curl_multi_wakeup(cb->multi);
+#endif
+  pthread_mutex_unlock(&cb->queue_lock);
+
+  return 0;
+} /* }}} int wg_submit */
+
+/* wg_io_dequeue takes requests off the queue, as long as fewer than
+ * "MaxInFlight" are running, and returns them as a list. Must be called with
+ * queue_lock held. */
+static wg_request_t *wg_io_dequeue(wg_callback_t *cb) {
+  wg_request_t *head = NULL;
+  wg_request_t **tail = &head;
+
+  while ((cb->queue_head != NULL) &&
+         (cb->in_flight < (size_t)cb->max_in_flight)) {
+    wg_request_t *r = cb->queue_head;
+    cb->queue_head = r->next;
+    if (cb->queue_head == NULL)
+      cb->queue_tail = NULL;
+    cb->queue_num--;
+    cb->in_flight++;
+
+    r->next = NULL;
+    *tail = r;
+    tail = &r->next;
+  }
+
+  /* There is room in the queue again. */
+  pthread_cond_broadcast(&cb->queue_cond);
+  return head;
+} /* wg_request_t *wg_io_dequeue */
+
+/* wg_io_refresh_auth renews the cached authorization header once a second.
+ * The OAuth code renews the token 30 seconds before it expires, so this
+ * keeps a valid token around even while no requests are sent. */
+static void wg_io_refresh_auth(wg_callback_t *cb) {
+  cdtime_t now = cdtime();
+  if ((cb->auth_header != NULL) &&
+      ((cb->auth_time + TIME_T_TO_CDTIME_T_STATIC(1)) > now))
+    return;
+
+  char *auth_header = wg_get_authorization_header(cb);
+  if (auth_header == NULL) {
+    /* Keep using the old token, it may still be valid. */
+    return;
+  }
+
+  sfree(cb->auth_header);
+  cb->auth_header = auth_header;
+  cb->auth_time = now;
+} /* void wg_io_refresh_auth */
+
+/* wg_io_add hands a dequeued request to the multi handle. */
+static void wg_io_add(wg_callback_t *cb, wg_request_t *r, char const *url) {
+  if (cb->auth_header == NULL) {
+    ERROR("write_stackdriver plugin: No access token available, dropping "
+          "request.");
+    wg_request_release(cb, r);
+    return;
+  }
+
+  r->curl_errbuf[0] = 0;
+  r->headers = curl_slist_append(NULL, "Content-Type: application/json");
+  r->headers = curl_slist_append(r->headers, cb->auth_header);
+
+  long timeout_ms = 2 * CDTIME_T_TO_MS(plugin_get_interval());
+  if (timeout_ms < 10000) {
+    timeout_ms = 10000;
+  }
+
+  curl_easy_setopt(r->curl, CURLOPT_URL, url);
+  curl_easy_setopt(r->curl, CURLOPT_TIMEOUT_MS, timeout_ms);
+  curl_easy_setopt(r->curl, CURLOPT_HTTPHEADER, r->headers);
+  curl_easy_setopt(r->curl, CURLOPT_POSTFIELDS, r->payload);
+
+  CURLMcode mstatus = curl_multi_add_handle(cb->multi, r->curl);
+  if (mstatus != CURLM_OK) {
+    ERROR("write_stackdriver plugin: curl_multi_add_handle failed: %s",
+          curl_multi_strerror(mstatus));
+    wg_request_release(cb, r);
+  }
+} /* void wg_io_add */
+
+/* wg_io_finish handles the requests the multi handle is done with. */
+static void wg_io_finish(wg_callback_t *cb, char const *url) {
+  CURLMsg *msg;
+  int msgs_left;
+
+  while ((msg = curl_multi_info_read(cb->multi, &msgs_left)) != NULL) {
+    if (msg->msg != CURLMSG_DONE)
+      continue;
+
+    wg_request_t *r = NULL;
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&r);
+    curl_multi_remove_handle(cb->multi, msg->easy_handle);
+
+    long http_code = 0;
+    curl_easy_getinfo(r->curl, CURLINFO_RESPONSE_CODE, &http_code);
+
+    if (msg->data.result != CURLE_OK) {
+      ERROR("write_stackdriver plugin: POST %s failed: %s", url,
+            r->curl_errbuf);
+    } else if ((http_code >= 400) && (http_code < 500)) {
+      ERROR("write_stackdriver plugin: POST %s: %s", url,
+            API_ERROR_STRING(parse_api_error(r->response.memory)));
+    } else if (http_code >= 500) {
+      WARNING("write_stackdriver plugin: POST %s: %s", url,
+              r->response.memory);
+    } else if (http_code != 200) {
+      ERROR("write_stackdriver plugin: POST %s: unexpected response code: "
+            "got %ld, want 200",
+            url, http_code);
+    }
+
+    wg_request_release(cb, r);
+  }
+} /* void wg_io_finish */
+
+static void *wg_io_thread(void *arg) /* {{{ */
+{
+  wg_callback_t *cb = arg;
+  char url[1024];
+
+  ssnprintf(url, sizeof(url), "%s/projects/%s/timeSeries", cb->url,
+            cb->project);
+
+  while (true) {
+    wg_io_refresh_auth(cb);
+
+    pthread_mutex_lock(&cb->queue_lock);
+    wg_request_t *start = wg_io_dequeue(cb);
+    bool done = cb->io_stop && (start == NULL) && (cb->queue_head == NULL) &&
+                (cb->in_flight == 0);
+    pthread_mutex_unlock(&cb->queue_lock);
+
+    if (done)
+      break;
+
+    while (start != NULL) {
+      wg_request_t *r = start;
+      start = r->next;
+      r->next = NULL;
+      wg_io_add(cb, r, url);
+    }
+
+    int running = 0;
+    CURLMcode status = curl_multi_perform(cb->multi, &running);
+    if (status != CURLM_OK)
+      ERROR("write_stackdriver plugin: curl_multi_perform failed: %s",
+            curl_multi_strerror(status));
+
+    wg_io_finish(cb, url);
+
+    /* Start queued requests right away if others have just finished. */
+    pthread_mutex_lock(&cb->queue_lock);
+    bool more = (cb->queue_head != NULL) &&
+                (cb->in_flight < (size_t)cb->max_in_flight);
+    pthread_mutex_unlock(&cb->queue_lock);
+    if (more)
+      continue;
+
+#if HAVE_CURL_MULTI_POLL
+    curl_multi_poll(cb->multi, NULL, 0, 1000, NULL);
+#else
+    /* Without curl_multi_wakeup(), new requests are noticed after at most
+     * 100 ms. */
+    curl_multi_wait(cb->multi, NULL, 0, 100, NULL);
+#endif
+  }
+
+  return NULL;
+} /* }}} void *wg_io_thread */
+
+static int wg_io_init(wg_callback_t *cb) /* {{{ */
+{
+  cb->multi = curl_multi_init();
+  if (cb->multi == NULL) {
+    ERROR("write_stackdriver plugin: curl_multi_init failed.");
+    return -1;
+  }
+#ifdef CURLPIPE_MULTIPLEX
+  curl_multi_setopt(cb->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+
+  int status = plugin_thread_create(&cb->io_thread, wg_io_thread, cb,
+                                    "stackdriver io");
+  if (status != 0) {
+    ERROR("write_stackdriver plugin: Starting the sender thread failed: %s",
+          STRERROR(status));
+    curl_multi_cleanup(cb->multi);
+    cb->multi = NULL;
+    return -1;
+  }
+  cb->io_thread_running = true;
+
+  return 0;
+} /* }}} int wg_io_init */
+
+/* wg_io_shutdown waits for the queued and running requests to finish and
+ * stops the sender thread. */
+static void wg_io_shutdown(wg_callback_t *cb) /* {{{ */
+{
+  if (cb->io_thread_running) {
+    pthread_mutex_lock(&cb->queue_lock);
+    cb->io_stop = true;
+    pthread_cond_broadcast(&cb->queue_cond);
+#if HAVE_CURL_MULTI_POLL
+    curl_multi_wakeup(cb->multi);
+#endif
+    pthread_mutex_unlock(&cb->queue_lock);
+
+    pthread_join(cb->io_thread, NULL);
+    cb->io_thread_running = false;
+  }
+
+  while (cb->idle != NULL) {
+    wg_request_t *r = cb->idle;
+    cb->idle = r->next;
+    wg_request_destroy(r);
+  }
+
+  if (cb->multi != NULL) {
+    curl_multi_cleanup(cb->multi);
+    cb->multi = NULL;
+  }
+  sfree(cb->auth_header);
+} /* }}} void wg_io_shutdown */
+/* }}} */
+
 static void wg_reset_buffer(wg_callback_t *cb) /* {{{ */
 {
   cb->timeseries_count = 0;
@@ -322,6 +698,12 @@ static int wg_callback_init(wg_callback_t *cb) /* {{{ */
   curl_easy_setopt(cb->curl, CURLOPT_ERRORBUFFER, cb->curl_errbuf);
   wg_reset_buffer(cb);
 
+  if ((cb->max_in_flight > 0) && (wg_io_init(cb) != 0)) {
+    WARNING("write_stackdriver plugin: Falling back to posting from the "
+            "write threads.");
+    cb->max_in_flight = 0;
+  }
+
   return 0;
 } /* }}} int wg_callback_init */
 
@@ -341,8 +723,15 @@ static int wg_flush_nolock(cdtime_t timeout, wg_callback_t *cb) /* {{{ */
   }
 
   char *payload = sd_output_reset(cb->formatter);
-  int status = wg_call_timeseries_write(cb, payload);
   wg_reset_buffer(cb);
+  if (payload == NULL)
+    return ENOMEM;
+
+  if (cb->io_thread_running)
+    return wg_submit(cb, payload);
+
+  int status = wg_call_timeseries_write(cb, payload);
+  sfree(payload);
   return status;
 } /* }}} wg_flush_nolock */
 
@@ -380,6 +769,12 @@ static void wg_callback_free(void *data) /* {{{ */
   if (cb == NULL)
     return;
 
+  if ((cb->formatter != NULL) && (cb->timeseries_count > 0))
+    wg_flush_nolock(/* timeout = */ 0, cb);
+  wg_io_shutdown(cb);
+  pthread_cond_destroy(&cb->queue_cond);
+  pthread_mutex_destroy(&cb->queue_lock);
+
   sd_output_destroy(cb->formatter);
   cb->formatter = NULL;
 
@@ -440,6 +835,11 @@ static int wg_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
     }
   }
 
+  /* Stay within the number of time series one request may carry. */
+  if ((cb->timeseries_count > 0) &&
+      ((cb->timeseries_count + ds->ds_num) > cb->batch_size))
+    wg_flush_nolock(0, cb);
+
   int status;
   while (42) {
     status = sd_output_add(cb->formatter, ds, vl);
@@ -466,7 +866,7 @@ static int wg_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
   }
 
   if (status == 0) {
-    cb->timeseries_count++;
+    cb->timeseries_count += ds->ds_num;
   }
 
   pthread_mutex_unlock(&cb->lock);
@@ -556,7 +956,10 @@ static int wg_config(oconfig_item_t *ci) /* {{{ */
     return ENOMEM;
   }
   cb->url = strdup(GCM_API_URL);
+  cb->batch_size = WG_MAX_BATCH_SIZE;
   pthread_mutex_init(&cb->lock, /* attr = */ NULL);
+  pthread_mutex_init(&cb->queue_lock, /* attr = */ NULL);
+  pthread_cond_init(&cb->queue_cond, /* attr = */ NULL);
 
   char *credential_file = NULL;
 
@@ -572,6 +975,22 @@ static int wg_config(oconfig_item_t *ci) /* {{{ */
       cf_util_get_string(child, &credential_file);
     else if (strcasecmp("Resource", child->key) == 0)
       wg_config_resource(child, cb);
+    else if (strcasecmp("BatchSize", child->key) == 0) {
+      int batch_size = 0;
+      if ((cf_util_get_int(child, &batch_size) != 0) || (batch_size < 1) ||
+          (batch_size > WG_MAX_BATCH_SIZE))
+        ERROR("write_stackdriver plugin: BatchSize must be between 1 and %d; "
+              "using %" PRIsz ".",
+              WG_MAX_BATCH_SIZE, cb->batch_size);
+      else
+        cb->batch_size = (size_t)batch_size;
+    } else if (strcasecmp("MaxInFlight", child->key) == 0) {
+      cf_util_get_int(child, &cb->max_in_flight);
+      if (cb->max_in_flight < 0) {
+        ERROR("write_stackdriver plugin: MaxInFlight must not be negative.");
+        cb->max_in_flight = 0;
+      }
+    }
     else {
       ERROR("write_stackdriver plugin: Invalid configuration option: %s.",
             child->key);
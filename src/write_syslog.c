@@ -54,7 +54,10 @@
 #include "utils_cache.h"
 #include "utils_random.h"
 
+#include "utils_complain.h"
+
 #include <netdb.h>
+#include <poll.h>
 
 #define WS_DEFAULT_NODE "localhost"
 
@@ -69,10 +72,18 @@
 /* Ethernet - (IPv6 + TCP) = 1500 - (40 + 32) = 1428 */
 #define WS_SEND_BUF_SIZE 1428
 
+#define WS_DEFAULT_BACKLOG_SIZE (1024 * 1024)
+
+/* Timeouts of the sender thread, bounding how long shutdown may take. */
+#define WS_CONNECT_TIMEOUT_MS 5000
+#define WS_SEND_TIMEOUT_MS 1000
+#define WS_RECONNECT_DELAY TIME_T_TO_CDTIME_T(1)
+
 /*
  * Private variables
  */
 struct ws_callback {
+  /* Only used by the sender thread. */
   struct addrinfo *ai;
   cdtime_t ai_last_update;
   int sock_fd;
@@ -84,13 +95,28 @@ struct ws_callback {
   char *metrics_prefix;
   bool store_rates;
   bool always_append_ds;
+  bool octet_counting;
+  size_t backlog_size;
 
-  char send_buf[WS_SEND_BUF_SIZE];
-  size_t send_buf_free;
+  /* Messages queued by the write callback, protected by send_lock. */
+  char *send_buf;
+  size_t send_buf_size;
   size_t send_buf_fill;
   cdtime_t send_buf_init_time;
+  bool flush_requested;
+  c_complain_t backlog_complaint;
+
+  /* Batch currently being sent, only used by the sender thread. */
+  char *inflight_buf;
+  size_t inflight_buf_size;
+  size_t inflight_fill;
+  size_t inflight_sent;
 
   pthread_mutex_t send_lock;
+  pthread_cond_t send_cond;
+  pthread_t sender;
+  bool sender_running;
+  bool shutdown;
 
   bool connect_failed_log_enabled;
   int connect_dns_failed_attempts_remaining;
@@ -103,58 +129,40 @@ static cdtime_t resolve_jitter;
 /*
  * Functions
  */
-static void ws_reset_buffer(struct ws_callback *cb) {
-  memset(cb->send_buf, 0, sizeof(cb->send_buf));
-  cb->send_buf_free = sizeof(cb->send_buf);
-  cb->send_buf_fill = 0;
-  cb->send_buf_init_time = cdtime();
+static void ws_close(struct ws_callback *cb) {
+  if (cb->sock_fd >= 0) {
+    close(cb->sock_fd);
+    cb->sock_fd = -1;
+  }
 }
 
-static int ws_send_buffer(struct ws_callback *cb) {
-  ssize_t status = 0;
-
-  status = swrite(cb->sock_fd, cb->send_buf, strlen(cb->send_buf));
-  if (status != 0) {
-    ERROR("write_syslog plugin: send failed with status %zi (%s)", status,
-          STRERRNO);
-
-    if (cb->sock_fd > 0) {
-      close(cb->sock_fd);
-      cb->sock_fd = -1;
+/* Returns the offset just past the message that starts at "pos". */
+static size_t ws_frame_end(const struct ws_callback *cb, const char *buf,
+                           size_t len, size_t pos) {
+  if (cb->octet_counting) {
+    size_t msg_len = 0;
+    while ((pos < len) && (buf[pos] != ' ')) {
+      msg_len = 10 * msg_len + (size_t)(buf[pos] - '0');
+      pos++;
     }
-
-    return -1;
+    pos += 1 + msg_len;
+  } else {
+    const char *nl = memchr(buf + pos, '\n', len - pos);
+    pos = (nl != NULL) ? (size_t)(nl - buf) + 1 : len;
   }
 
-  return 0;
+  return (pos < len) ? pos : len;
 }
 
-/* NOTE: You must hold cb->send_lock when calling this function! */
-static int ws_flush_nolock(cdtime_t timeout, struct ws_callback *cb) {
-  int status;
+/* A message that has only been sent partially before the connection broke
+ * would corrupt the framing of the next connection. Skip its remainder. */
+static void ws_skip_partial(struct ws_callback *cb) {
+  size_t pos = 0;
 
-  DEBUG("write_syslog plugin: ws_flush_nolock: timeout = %.3f; "
-        "send_buf_fill = %" PRIsz ";",
-        (double)timeout, cb->send_buf_fill);
+  while (pos < cb->inflight_sent)
+    pos = ws_frame_end(cb, cb->inflight_buf, cb->inflight_fill, pos);
 
-  /* timeout == 0  => flush unconditionally */
-  if (timeout > 0) {
-    cdtime_t now;
-
-    now = cdtime();
-    if ((cb->send_buf_init_time + timeout) > now)
-      return 0;
-  }
-
-  if (cb->send_buf_fill == 0) {
-    cb->send_buf_init_time = cdtime();
-    return 0;
-  }
-
-  status = ws_send_buffer(cb);
-  ws_reset_buffer(cb);
-
-  return status;
+  cb->inflight_sent = pos;
 }
 
 static cdtime_t new_random_ttl(void) {
@@ -164,6 +172,37 @@ static cdtime_t new_random_ttl(void) {
   return (cdtime_t)cdrand_range(0, (long)resolve_jitter);
 }
 
+static int ws_connect(int fd, const struct addrinfo *ai) {
+  int flags = fcntl(fd, F_GETFL);
+  if ((flags < 0) || (fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0))
+    return -1;
+
+  if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+    return 0;
+  if (errno != EINPROGRESS)
+    return -1;
+
+  struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+  int status = poll(&pfd, 1, WS_CONNECT_TIMEOUT_MS);
+  if (status == 0)
+    errno = ETIMEDOUT;
+  if (status <= 0)
+    return -1;
+
+  int error = 0;
+  if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error,
+                 &(socklen_t){sizeof(error)}) != 0)
+    return -1;
+  if (error != 0) {
+    errno = error;
+    return -1;
+  }
+
+  return 0;
+}
+
+/* Resolves and connects the node. Only called by the sender thread, so
+ * neither DNS lookups nor connection attempts block the write callback. */
 static int ws_callback_init(struct ws_callback *cb) {
   int status;
   cdtime_t now;
@@ -185,9 +224,8 @@ static int ws_callback_init(struct ws_callback *cb) {
     if ((cb->ai_last_update + resolve_interval + cb->next_random_ttl) < now) {
       cb->next_random_ttl = new_random_ttl();
       if (cb->connect_dns_failed_attempts_remaining > 0) {
-        /* Warning : this is run under send_lock mutex.
-         * This is why we do not use another mutex here.
-         * */
+        /* Only the sender thread touches the resolver state, so no lock is
+         * needed here. */
         cb->ai_last_update = now;
         cb->connect_dns_failed_attempts_remaining--;
       } else {
@@ -235,10 +273,9 @@ static int ws_callback_init(struct ws_callback *cb) {
 
     set_sock_opts(cb->sock_fd);
 
-    status = connect(cb->sock_fd, ai->ai_addr, ai->ai_addrlen);
+    status = ws_connect(cb->sock_fd, ai);
     if (status != 0) {
-      close(cb->sock_fd);
-      cb->sock_fd = -1;
+      ws_close(cb);
       continue;
     }
 
@@ -246,9 +283,12 @@ static int ws_callback_init(struct ws_callback *cb) {
   }
 
   if (cb->sock_fd < 0) {
-    ERROR("write_syslog plugin: Connecting to %s:%s failed. "
-          "The last error was: %s",
-          node, service, STRERRNO);
+    if (cb->connect_failed_log_enabled) {
+      ERROR("write_syslog plugin: Connecting to %s:%s failed. "
+            "The last error was: %s",
+            node, service, STRERRNO);
+      cb->connect_failed_log_enabled = 0;
+    }
     return -1;
   }
 
@@ -258,11 +298,102 @@ static int ws_callback_init(struct ws_callback *cb) {
   }
   cb->connect_dns_failed_attempts_remaining = 1;
 
-  ws_reset_buffer(cb);
+  return 0;
+}
 
+/* Sends the in-flight batch. Returns EAGAIN if the receiver did not accept
+ * data within WS_SEND_TIMEOUT_MS and -1 if the connection failed. */
+static int ws_send_inflight(struct ws_callback *cb) {
+  if ((cb->sock_fd < 0) && (ws_callback_init(cb) != 0))
+    return -1;
+
+  while (cb->inflight_sent < cb->inflight_fill) {
+    ssize_t status = send(cb->sock_fd, cb->inflight_buf + cb->inflight_sent,
+                          cb->inflight_fill - cb->inflight_sent,
+                          MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (status >= 0) {
+      cb->inflight_sent += (size_t)status;
+      continue;
+    }
+
+    if (errno == EINTR)
+      continue;
+
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+      struct pollfd pfd = {.fd = cb->sock_fd, .events = POLLOUT};
+      int ret = poll(&pfd, 1, WS_SEND_TIMEOUT_MS);
+      if (ret == 0)
+        return EAGAIN;
+      if ((ret > 0) || (errno == EINTR))
+        continue;
+    }
+
+    ERROR("write_syslog plugin: send failed: %s", STRERRNO);
+    ws_close(cb);
+    ws_skip_partial(cb);
+    return -1;
+  }
+
+  cb->inflight_fill = 0;
+  cb->inflight_sent = 0;
   return 0;
 }
 
+/* NOTE: You must hold cb->send_lock when calling this function! */
+static bool ws_batch_ready(const struct ws_callback *cb) {
+  if (cb->send_buf_fill == 0)
+    return false;
+
+  return cb->shutdown || cb->flush_requested ||
+         (cb->send_buf_fill >= WS_SEND_BUF_SIZE);
+}
+
+/* The sender thread takes the queued messages as a whole and writes them
+ * with as few send(2) calls as the receiver allows. Write callbacks only
+ * append to the queue and never wait for the network. */
+static void *ws_sender_thread(void *arg) {
+  struct ws_callback *cb = arg;
+
+  pthread_mutex_lock(&cb->send_lock);
+  while (true) {
+    if (cb->inflight_sent >= cb->inflight_fill) {
+      while (!cb->shutdown && !ws_batch_ready(cb))
+        pthread_cond_wait(&cb->send_cond, &cb->send_lock);
+      if (!ws_batch_ready(cb))
+        break;
+
+      char *tmp = cb->inflight_buf;
+      size_t tmp_size = cb->inflight_buf_size;
+      cb->inflight_buf = cb->send_buf;
+      cb->inflight_buf_size = cb->send_buf_size;
+      cb->inflight_fill = cb->send_buf_fill;
+      cb->inflight_sent = 0;
+      cb->send_buf = tmp;
+      cb->send_buf_size = tmp_size;
+      cb->send_buf_fill = 0;
+      cb->send_buf_init_time = cdtime();
+      cb->flush_requested = false;
+    }
+
+    pthread_mutex_unlock(&cb->send_lock);
+    int status = ws_send_inflight(cb);
+    pthread_mutex_lock(&cb->send_lock);
+
+    if ((status != 0) && cb->shutdown)
+      break;
+
+    if (status < 0) {
+      cdtime_t deadline = cdtime() + WS_RECONNECT_DELAY;
+      struct timespec ts = CDTIME_T_TO_TIMESPEC(deadline);
+      while (!cb->shutdown && (cdtime() < deadline))
+        pthread_cond_timedwait(&cb->send_cond, &cb->send_lock, &ts);
+    }
+  }
+  pthread_mutex_unlock(&cb->send_lock);
+
+  return NULL;
+}
+
 static void ws_callback_free(void *data) {
   struct ws_callback *cb;
 
@@ -271,20 +402,28 @@ static void ws_callback_free(void *data) {
 
   cb = data;
 
+  /* The sender thread drains the queue before it exits. */
   pthread_mutex_lock(&cb->send_lock);
+  cb->shutdown = true;
+  pthread_cond_signal(&cb->send_cond);
+  pthread_mutex_unlock(&cb->send_lock);
 
-  ws_flush_nolock(0, cb);
+  if (cb->sender_running)
+    pthread_join(cb->sender, NULL);
 
-  close(cb->sock_fd);
-  cb->sock_fd = -1;
+  ws_close(cb);
+  if (cb->ai != NULL)
+    freeaddrinfo(cb->ai);
 
   sfree(cb->node);
   sfree(cb->service);
   sfree(cb->host_tags);
   sfree(cb->msg_format);
   sfree(cb->metrics_prefix);
+  sfree(cb->send_buf);
+  sfree(cb->inflight_buf);
 
-  pthread_mutex_unlock(&cb->send_lock);
+  pthread_cond_destroy(&cb->send_cond);
   pthread_mutex_destroy(&cb->send_lock);
 
   sfree(cb);
@@ -294,7 +433,6 @@ static int ws_flush(cdtime_t timeout,
                     const char *identifier __attribute__((unused)),
                     user_data_t *user_data) {
   struct ws_callback *cb;
-  int status;
 
   if (user_data == NULL)
     return -EINVAL;
@@ -303,19 +441,80 @@ static int ws_flush(cdtime_t timeout,
 
   pthread_mutex_lock(&cb->send_lock);
 
-  if (cb->sock_fd < 0) {
-    status = ws_callback_init(cb);
-    if (status != 0) {
-      ERROR("write_syslog plugin: ws_callback_init failed.");
-      pthread_mutex_unlock(&cb->send_lock);
-      return -1;
-    }
+  DEBUG("write_syslog plugin: ws_flush: timeout = %.3f; "
+        "send_buf_fill = %" PRIsz ";",
+        CDTIME_T_TO_DOUBLE(timeout), cb->send_buf_fill);
+
+  /* timeout == 0  => flush unconditionally */
+  if ((timeout == 0) || ((cb->send_buf_init_time + timeout) <= cdtime())) {
+    cb->flush_requested = true;
+    pthread_cond_signal(&cb->send_cond);
   }
 
-  status = ws_flush_nolock(timeout, cb);
   pthread_mutex_unlock(&cb->send_lock);
 
-  return status;
+  return 0;
+}
+
+/* NOTE: You must hold cb->send_lock when calling this function! */
+static int ws_enqueue_nolock(struct ws_callback *cb, const char *message,
+                             size_t message_len) {
+  char prefix[32] = "";
+  size_t prefix_len = 0;
+  size_t suffix_len = 1;
+
+  if (cb->octet_counting) {
+    /* RFC 6587, section 3.4.1: MSG-LEN SP SYSLOG-MSG */
+    snprintf(prefix, sizeof(prefix), "%" PRIsz " ", message_len);
+    prefix_len = strlen(prefix);
+    suffix_len = 0;
+  }
+
+  size_t frame_len = prefix_len + message_len + suffix_len;
+  if (cb->send_buf_fill + frame_len > cb->backlog_size) {
+    c_complain(LOG_WARNING, &cb->backlog_complaint,
+               "write_syslog plugin: [%s]:%s backlog of %" PRIsz
+               " bytes is full, dropping messages.",
+               cb->node ? cb->node : WS_DEFAULT_NODE,
+               cb->service ? cb->service : WS_DEFAULT_SERVICE,
+               cb->backlog_size);
+    return ENOBUFS;
+  }
+
+  if (cb->send_buf_fill + frame_len > cb->send_buf_size) {
+    size_t new_size = 2 * cb->send_buf_size;
+    if (new_size < WS_SEND_BUF_SIZE)
+      new_size = WS_SEND_BUF_SIZE;
+    while (new_size < cb->send_buf_fill + frame_len)
+      new_size *= 2;
+    if (new_size > cb->backlog_size)
+      new_size = cb->backlog_size;
+
+    char *tmp = realloc(cb->send_buf, new_size);
+    if (tmp == NULL) {
+      ERROR("write_syslog plugin: realloc failed.");
+      return ENOMEM;
+    }
+    cb->send_buf = tmp;
+    cb->send_buf_size = new_size;
+  }
+
+  if (cb->send_buf_fill == 0)
+    cb->send_buf_init_time = cdtime();
+
+  char *dst = cb->send_buf + cb->send_buf_fill;
+  memcpy(dst, prefix, prefix_len);
+  memcpy(dst + prefix_len, message, message_len);
+  if (suffix_len > 0)
+    dst[prefix_len + message_len] = '\n';
+  cb->send_buf_fill += frame_len;
+
+  c_release(LOG_INFO, &cb->backlog_complaint,
+            "write_syslog plugin: [%s]:%s backlog accepts messages again.",
+            cb->node ? cb->node : WS_DEFAULT_NODE,
+            cb->service ? cb->service : WS_DEFAULT_SERVICE);
+
+  return 0;
 }
 
 static int ws_format_values(char *ret, size_t ret_len, int ds_num,
@@ -323,7 +522,8 @@ static int ws_format_values(char *ret, size_t ret_len, int ds_num,
                             bool store_rates) {
   size_t offset = 0;
   int status;
-  gauge_t *rates = NULL;
+  gauge_t const *rates = NULL;
+  gauge_t *rates_alloc = NULL;
 
   assert(strcmp(ds->type, vl->type) == 0);
 
@@ -333,10 +533,10 @@ static int ws_format_values(char *ret, size_t ret_len, int ds_num,
   do {                                                                         \
     status = snprintf(ret + offset, ret_len - offset, __VA_ARGS__);            \
     if (status < 1) {                                                          \
-      sfree(rates);                                                            \
+      sfree(rates_alloc);                                                      \
       return -1;                                                               \
     } else if (((size_t)status) >= (ret_len - offset)) {                       \
-      sfree(rates);                                                            \
+      sfree(rates_alloc);                                                      \
       return -1;                                                               \
     } else                                                                     \
       offset += ((size_t)status);                                              \
@@ -346,7 +546,7 @@ static int ws_format_values(char *ret, size_t ret_len, int ds_num,
     BUFFER_ADD(GAUGE_FORMAT, vl->values[ds_num].gauge);
   else if (store_rates) {
     if (rates == NULL)
-      rates = uc_get_rate(ds, vl);
+      rates = uc_get_rate_attached(ds, vl, &rates_alloc);
     if (rates == NULL) {
       WARNING("format_values: "
               "uc_get_rate failed.");
@@ -362,13 +562,13 @@ static int ws_format_values(char *ret, size_t ret_len, int ds_num,
   else {
     ERROR("format_values plugin: Unknown data source type: %i",
           ds->ds[ds_num].type);
-    sfree(rates);
+    sfree(rates_alloc);
     return -1;
   }
 
 #undef BUFFER_ADD
 
-  sfree(rates);
+  sfree(rates_alloc);
   return 0;
 }
 
@@ -422,7 +622,7 @@ static int ws_send_message(const char *key, const char *value, cdtime_t time,
         "\"plugin\":\"%s\", \"plugin_instance\":\"%s\", "
         "\"type_instance\":\"%s\","
         " \"type\":\"%s\", \"interval\":%.0f }, \"hostname\":\"%s\" %s "
-        "%s}\n",
+        "%s}",
         rfc3339_timestamp, host, pid, CDTIME_T_TO_DOUBLE(time), metrics_prefix,
         plugin, key, value, plugin, plugin_instance, type_instance, type,
         CDTIME_T_TO_DOUBLE(interval), host, host_tags_json_prefix, host_tags);
@@ -434,7 +634,7 @@ static int ws_send_message(const char *key, const char *value, cdtime_t time,
         "<166>1 %s %s collectd %d - [%s value=\"%s\""
         " plugin=\"%s\" plugin_instance=\"%s\""
         " type_instance=\"%s\" type=\"%s\""
-        " ds_name=\"%s\" interval=\"%.0f\"] %s %s.%s=\"%s\"\n",
+        " ds_name=\"%s\" interval=\"%.0f\"] %s %s.%s=\"%s\"",
         rfc3339_timestamp, host, pid, metrics_prefix, value, plugin,
         plugin_instance, type_instance, type, ds_name,
         CDTIME_T_TO_DOUBLE(interval), host_tags, plugin, key, value);
@@ -452,41 +652,31 @@ static int ws_send_message(const char *key, const char *value, cdtime_t time,
 
   pthread_mutex_lock(&cb->send_lock);
 
-  if (cb->sock_fd < 0) {
-    status = ws_callback_init(cb);
+  if (!cb->sender_running) {
+    status = plugin_thread_create(&cb->sender, ws_sender_thread, cb,
+                                  "write_syslog");
     if (status != 0) {
-      ERROR("write_syslog plugin: ws_callback_init failed.");
+      ERROR("write_syslog plugin: Starting the sender thread failed.");
       pthread_mutex_unlock(&cb->send_lock);
       return -1;
     }
+    cb->sender_running = true;
   }
 
-  if (message_len >= cb->send_buf_free) {
-    status = ws_flush_nolock(0, cb);
-    if (status != 0) {
-      pthread_mutex_unlock(&cb->send_lock);
-      return status;
-    }
-  }
-
-  /* Assert that we have enough space for this message. */
-  assert(message_len < cb->send_buf_free);
+  status = ws_enqueue_nolock(cb, message, message_len);
+  if (status == 0) {
+    if (cb->send_buf_fill >= WS_SEND_BUF_SIZE)
+      pthread_cond_signal(&cb->send_cond);
 
-  /* `message_len + 1' because `message_len' does not include the
-   * trailing null byte. Neither does `send_buffer_fill'. */
-  memcpy(cb->send_buf + cb->send_buf_fill, message, message_len + 1);
-  cb->send_buf_fill += message_len;
-  cb->send_buf_free -= message_len;
-
-  DEBUG("write_syslog plugin: [%s]:%s buf %" PRIsz "/%" PRIsz
-        " (%.1f %%) \"%s\"",
-        cb->node, cb->service, cb->send_buf_fill, sizeof(cb->send_buf),
-        100.0 * ((double)cb->send_buf_fill) / ((double)sizeof(cb->send_buf)),
-        message);
+    DEBUG("write_syslog plugin: [%s]:%s backlog %" PRIsz "/%" PRIsz
+          " \"%s\"",
+          cb->node, cb->service, cb->send_buf_fill, cb->backlog_size, message);
+  }
 
   pthread_mutex_unlock(&cb->send_lock);
 
-  return 0;
+  /* A full backlog has already been reported by ws_enqueue_nolock(). */
+  return (status == ENOBUFS) ? 0 : status;
 }
 
 static int ws_write_messages(const data_set_t *ds, const value_list_t *vl,
@@ -567,8 +757,12 @@ static int ws_config_tsd(oconfig_item_t *ci) {
   cb->sock_fd = -1;
   cb->connect_failed_log_enabled = 1;
   cb->next_random_ttl = new_random_ttl();
+  cb->octet_counting = true;
+  cb->backlog_size = WS_DEFAULT_BACKLOG_SIZE;
+  C_COMPLAIN_INIT(&cb->backlog_complaint);
 
   pthread_mutex_init(&cb->send_lock, NULL);
+  pthread_cond_init(&cb->send_cond, NULL);
 
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
@@ -587,10 +781,39 @@ static int ws_config_tsd(oconfig_item_t *ci) {
       cf_util_get_boolean(child, &cb->always_append_ds);
     else if (strcasecmp("Prefix", child->key) == 0)
       cf_util_get_string(child, &cb->metrics_prefix);
-    else {
+    else if (strcasecmp("Framing", child->key) == 0) {
+      char *framing = NULL;
+      if (cf_util_get_string(child, &framing) != 0) {
+        ws_callback_free(cb);
+        return -1;
+      }
+      if (strcasecmp("octet-counting", framing) == 0)
+        cb->octet_counting = true;
+      else if (strcasecmp("non-transparent", framing) == 0)
+        cb->octet_counting = false;
+      else {
+        ERROR("write_syslog plugin: Invalid Framing \"%s\". Expected "
+              "\"octet-counting\" or \"non-transparent\".",
+              framing);
+        sfree(framing);
+        ws_callback_free(cb);
+        return -1;
+      }
+      sfree(framing);
+    } else if (strcasecmp("BacklogSize", child->key) == 0) {
+      int size = 0;
+      if ((cf_util_get_int(child, &size) != 0) || (size < WS_SEND_BUF_SIZE)) {
+        ERROR("write_syslog plugin: BacklogSize must be at least %d bytes.",
+              WS_SEND_BUF_SIZE);
+        ws_callback_free(cb);
+        return -1;
+      }
+      cb->backlog_size = (size_t)size;
+    } else {
       ERROR("write_syslog plugin: Invalid configuration "
             "option: %s.",
             child->key);
+      ws_callback_free(cb);
       return -1;
     }
   }
@@ -45,10 +45,8 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/tcp_pool/tcp_pool.h"
 #include "utils_cache.h"
-#include "utils_random.h"
-
-#include <netdb.h>
 
 #ifndef WT_DEFAULT_NODE
 #define WT_DEFAULT_NODE "localhost"
@@ -67,14 +65,20 @@
 #define WT_SEND_BUF_SIZE 1428
 #endif
 
+/* Maximum amount of data queued per connection by default. */
+#ifndef WT_DEFAULT_BACKLOG_SIZE
+#define WT_DEFAULT_BACKLOG_SIZE (1024 * 1024)
+#endif
+
 /*
  * Private variables
  */
-struct wt_callback {
-  struct addrinfo *ai;
-  cdtime_t ai_last_update;
-  int sock_fd;
+typedef struct {
+  char *node;
+  char *service;
+} wt_server_t;
 
+struct wt_callback {
   char *node;
   char *service;
   char *host_tags;
@@ -82,180 +86,60 @@ struct wt_callback {
   bool store_rates;
   bool always_append_ds;
 
-  char send_buf[WT_SEND_BUF_SIZE];
-  size_t send_buf_free;
-  size_t send_buf_fill;
-  cdtime_t send_buf_init_time;
+  wt_server_t *servers;
+  size_t servers_num;
+  int connections;
+  size_t backlog_size;
 
-  pthread_mutex_t send_lock;
-
-  bool connect_failed_log_enabled;
-  int connect_dns_failed_attempts_remaining;
-  cdtime_t next_random_ttl;
+  /* Created on first use, so the I/O thread is started after the daemon
+   * forked. */
+  pthread_mutex_t pool_lock;
+  c_tcp_pool_t *pool;
 };
 
+/* Complete lines collected by a write callback before they are handed to the
+ * pool, so the pool's lock is taken once per block instead of once per line.
+ */
+typedef struct {
+  char data[WT_SEND_BUF_SIZE];
+  size_t len;
+} wt_block_t;
+
 static cdtime_t resolve_interval;
 static cdtime_t resolve_jitter;
 
 /*
  * Functions
  */
-static void wt_reset_buffer(struct wt_callback *cb) {
-  memset(cb->send_buf, 0, sizeof(cb->send_buf));
-  cb->send_buf_free = sizeof(cb->send_buf);
-  cb->send_buf_fill = 0;
-  cb->send_buf_init_time = cdtime();
-}
-
-static int wt_send_buffer(struct wt_callback *cb) {
-  ssize_t status = 0;
-
-  status = swrite(cb->sock_fd, cb->send_buf, strlen(cb->send_buf));
-  if (status != 0) {
-    ERROR("write_tsdb plugin: send failed with status %zi (%s)", status,
-          STRERRNO);
-
-    close(cb->sock_fd);
-    cb->sock_fd = -1;
-
-    return -1;
+static c_tcp_pool_t *wt_pool(struct wt_callback *cb) {
+  pthread_mutex_lock(&cb->pool_lock);
+  if (cb->pool == NULL) {
+    c_tcp_pool_server_t servers[cb->servers_num];
+    for (size_t i = 0; i < cb->servers_num; i++)
+      servers[i] = (c_tcp_pool_server_t){
+          .node = cb->servers[i].node,
+          .service = cb->servers[i].service,
+      };
+
+    cb->pool = c_tcp_pool_create(&(c_tcp_pool_options_t){
+        .name = "write_tsdb",
+        .servers = servers,
+        .servers_num = cb->servers_num,
+        .connections = (size_t)cb->connections,
+        .buffer_size = WT_SEND_BUF_SIZE,
+        .backlog_size = cb->backlog_size,
+        .resolve_interval = resolve_interval,
+        .resolve_jitter = resolve_jitter,
+    });
+    if (cb->pool == NULL)
+      ERROR("write_tsdb plugin: Creating the connection pool for %s:%s "
+            "failed.",
+            cb->servers[0].node, cb->servers[0].service);
   }
+  c_tcp_pool_t *pool = cb->pool;
+  pthread_mutex_unlock(&cb->pool_lock);
 
-  return 0;
-}
-
-/* NOTE: You must hold cb->send_lock when calling this function! */
-static int wt_flush_nolock(cdtime_t timeout, struct wt_callback *cb) {
-  int status;
-
-  DEBUG("write_tsdb plugin: wt_flush_nolock: timeout = %.3f; "
-        "send_buf_fill = %" PRIsz ";",
-        (double)timeout, cb->send_buf_fill);
-
-  /* timeout == 0  => flush unconditionally */
-  if (timeout > 0) {
-    cdtime_t now;
-
-    now = cdtime();
-    if ((cb->send_buf_init_time + timeout) > now)
-      return 0;
-  }
-
-  if (cb->send_buf_fill == 0) {
-    cb->send_buf_init_time = cdtime();
-    return 0;
-  }
-
-  status = wt_send_buffer(cb);
-  wt_reset_buffer(cb);
-
-  return status;
-}
-
-static cdtime_t new_random_ttl(void) {
-  if (resolve_jitter == 0)
-    return 0;
-
-  return (cdtime_t)cdrand_range(0, (long)resolve_jitter);
-}
-
-static int wt_callback_init(struct wt_callback *cb) {
-  int status;
-  cdtime_t now;
-
-  const char *node = cb->node ? cb->node : WT_DEFAULT_NODE;
-  const char *service = cb->service ? cb->service : WT_DEFAULT_SERVICE;
-
-  if (cb->sock_fd > 0)
-    return 0;
-
-  now = cdtime();
-  if (cb->ai) {
-    /* When we are here, we still have the IP in cache.
-     * If we have remaining attempts without calling the DNS, we update the
-     * last_update date so we keep the info until next time.
-     * If there is no more attempts, we need to flush the cache.
-     */
-
-    if ((cb->ai_last_update + resolve_interval + cb->next_random_ttl) < now) {
-      cb->next_random_ttl = new_random_ttl();
-      if (cb->connect_dns_failed_attempts_remaining > 0) {
-        /* Warning : this is run under send_lock mutex.
-         * This is why we do not use another mutex here.
-         * */
-        cb->ai_last_update = now;
-        cb->connect_dns_failed_attempts_remaining--;
-      } else {
-        freeaddrinfo(cb->ai);
-        cb->ai = NULL;
-      }
-    }
-  }
-
-  if (cb->ai == NULL) {
-    if ((cb->ai_last_update + resolve_interval + cb->next_random_ttl) >= now) {
-      DEBUG("write_tsdb plugin: too many getaddrinfo(%s, %s) failures", node,
-            service);
-      return -1;
-    }
-    cb->ai_last_update = now;
-    cb->next_random_ttl = new_random_ttl();
-
-    struct addrinfo ai_hints = {
-        .ai_family = AF_UNSPEC,
-        .ai_flags = AI_ADDRCONFIG,
-        .ai_socktype = SOCK_STREAM,
-    };
-
-    status = getaddrinfo(node, service, &ai_hints, &cb->ai);
-    if (status != 0) {
-      if (cb->ai) {
-        freeaddrinfo(cb->ai);
-        cb->ai = NULL;
-      }
-      if (cb->connect_failed_log_enabled) {
-        ERROR("write_tsdb plugin: getaddrinfo(%s, %s) failed: %s", node,
-              service, gai_strerror(status));
-        cb->connect_failed_log_enabled = 0;
-      }
-      return -1;
-    }
-  }
-
-  assert(cb->ai != NULL);
-  for (struct addrinfo *ai = cb->ai; ai != NULL; ai = ai->ai_next) {
-    cb->sock_fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
-    if (cb->sock_fd < 0)
-      continue;
-
-    set_sock_opts(cb->sock_fd);
-
-    status = connect(cb->sock_fd, ai->ai_addr, ai->ai_addrlen);
-    if (status != 0) {
-      close(cb->sock_fd);
-      cb->sock_fd = -1;
-      continue;
-    }
-
-    break;
-  }
-
-  if (cb->sock_fd < 0) {
-    ERROR("write_tsdb plugin: Connecting to %s:%s failed. "
-          "The last error was: %s",
-          node, service, STRERRNO);
-    return -1;
-  }
-
-  if (0 == cb->connect_failed_log_enabled) {
-    WARNING("write_tsdb plugin: Connecting to %s:%s succeeded.", node, service);
-    cb->connect_failed_log_enabled = 1;
-  }
-  cb->connect_dns_failed_attempts_remaining = 1;
-
-  wt_reset_buffer(cb);
-
-  return 0;
+  return pool;
 }
 
 static void wt_callback_free(void *data) {
@@ -266,19 +150,19 @@ static void wt_callback_free(void *data) {
 
   cb = data;
 
-  pthread_mutex_lock(&cb->send_lock);
+  c_tcp_pool_destroy(cb->pool);
 
-  wt_flush_nolock(0, cb);
-
-  close(cb->sock_fd);
-  cb->sock_fd = -1;
+  for (size_t i = 0; i < cb->servers_num; i++) {
+    sfree(cb->servers[i].node);
+    sfree(cb->servers[i].service);
+  }
+  sfree(cb->servers);
 
   sfree(cb->node);
   sfree(cb->service);
   sfree(cb->host_tags);
 
-  pthread_mutex_unlock(&cb->send_lock);
-  pthread_mutex_destroy(&cb->send_lock);
+  pthread_mutex_destroy(&cb->pool_lock);
 
   sfree(cb);
 }
@@ -287,28 +171,18 @@ static int wt_flush(cdtime_t timeout,
                     const char *identifier __attribute__((unused)),
                     user_data_t *user_data) {
   struct wt_callback *cb;
-  int status;
 
   if (user_data == NULL)
     return -EINVAL;
 
   cb = user_data->data;
 
-  pthread_mutex_lock(&cb->send_lock);
-
-  if (cb->sock_fd < 0) {
-    status = wt_callback_init(cb);
-    if (status != 0) {
-      ERROR("write_tsdb plugin: wt_callback_init failed.");
-      pthread_mutex_unlock(&cb->send_lock);
-      return -1;
-    }
-  }
-
-  status = wt_flush_nolock(timeout, cb);
-  pthread_mutex_unlock(&cb->send_lock);
+  c_tcp_pool_t *pool = wt_pool(cb);
+  if (pool == NULL)
+    return -1;
 
-  return status;
+  c_tcp_pool_flush(pool, timeout);
+  return 0;
 }
 
 static int wt_format_values(char *ret, size_t ret_len, int ds_num,
@@ -316,7 +190,8 @@ static int wt_format_values(char *ret, size_t ret_len, int ds_num,
                             bool store_rates) {
   size_t offset = 0;
   int status;
-  gauge_t *rates = NULL;
+  gauge_t const *rates = NULL;
+  gauge_t *rates_alloc = NULL;
 
   assert(0 == strcmp(ds->type, vl->type));
 
@@ -326,10 +201,10 @@ static int wt_format_values(char *ret, size_t ret_len, int ds_num,
   do {                                                                         \
     status = snprintf(ret + offset, ret_len - offset, __VA_ARGS__);            \
     if (status < 1) {                                                          \
-      sfree(rates);                                                            \
+      sfree(rates_alloc);                                                      \
       return -1;                                                               \
     } else if (((size_t)status) >= (ret_len - offset)) {                       \
-      sfree(rates);                                                            \
+      sfree(rates_alloc);                                                      \
       return -1;                                                               \
     } else                                                                     \
       offset += ((size_t)status);                                              \
@@ -339,7 +214,7 @@ static int wt_format_values(char *ret, size_t ret_len, int ds_num,
     BUFFER_ADD(GAUGE_FORMAT, vl->values[ds_num].gauge);
   else if (store_rates) {
     if (rates == NULL)
-      rates = uc_get_rate(ds, vl);
+      rates = uc_get_rate_attached(ds, vl, &rates_alloc);
     if (rates == NULL) {
       WARNING("format_values: "
               "uc_get_rate failed.");
@@ -355,13 +230,13 @@ static int wt_format_values(char *ret, size_t ret_len, int ds_num,
   else {
     ERROR("format_values plugin: Unknown data source type: %i",
           ds->ds[ds_num].type);
-    sfree(rates);
+    sfree(rates_alloc);
     return -1;
   }
 
 #undef BUFFER_ADD
 
-  sfree(rates);
+  sfree(rates_alloc);
   return 0;
 }
 
@@ -425,9 +300,29 @@ static int wt_format_name(char *ret, int ret_len, const value_list_t *vl,
   return 0;
 }
 
+/* wt_block_send hands the collected lines to the pool. */
+static int wt_block_send(struct wt_callback *cb, wt_block_t *block) {
+  if (block->len == 0)
+    return 0;
+
+  c_tcp_pool_t *pool = wt_pool(cb);
+  if (pool == NULL)
+    return -1;
+
+  int status = c_tcp_pool_send(pool, block->data, block->len);
+  block->len = 0;
+  if (status != 0) {
+    ERROR("write_tsdb plugin: Queueing data for %s:%s failed: %s",
+          cb->servers[0].node, cb->servers[0].service, STRERROR(status));
+    return -1;
+  }
+
+  return 0;
+}
+
 static int wt_send_message(const char *key, const char *value, cdtime_t time,
                            struct wt_callback *cb, const char *host,
-                           meta_data_t *md) {
+                           meta_data_t *md, wt_block_t *block) {
   int status;
   size_t message_len;
   char *temp = NULL;
@@ -447,7 +342,6 @@ static int wt_send_message(const char *key, const char *value, cdtime_t time,
     } else if (status < 0) {
       ERROR("write_tsdb plugin: tags metadata get failure");
       sfree(temp);
-      pthread_mutex_unlock(&cb->send_lock);
       return status;
     } else {
       tags = temp;
@@ -469,46 +363,27 @@ static int wt_send_message(const char *key, const char *value, cdtime_t time,
     return -1;
   }
 
-  pthread_mutex_lock(&cb->send_lock);
-
-  if (cb->sock_fd < 0) {
-    status = wt_callback_init(cb);
-    if (status != 0) {
-      ERROR("write_tsdb plugin: wt_callback_init failed.");
-      pthread_mutex_unlock(&cb->send_lock);
-      return -1;
-    }
-  }
-
-  if (message_len >= cb->send_buf_free) {
-    status = wt_flush_nolock(0, cb);
-    if (status != 0) {
-      pthread_mutex_unlock(&cb->send_lock);
+  if (message_len > sizeof(block->data) - block->len) {
+    status = wt_block_send(cb, block);
+    if (status != 0)
       return status;
-    }
   }
 
   /* Assert that we have enough space for this message. */
-  assert(message_len < cb->send_buf_free);
+  assert(message_len <= sizeof(block->data) - block->len);
 
-  /* `message_len + 1' because `message_len' does not include the
-   * trailing null byte. Neither does `send_buffer_fill'. */
-  memcpy(cb->send_buf + cb->send_buf_fill, message, message_len + 1);
-  cb->send_buf_fill += message_len;
-  cb->send_buf_free -= message_len;
+  memcpy(block->data + block->len, message, message_len);
+  block->len += message_len;
 
-  DEBUG("write_tsdb plugin: [%s]:%s buf %" PRIsz "/%" PRIsz " (%.1f %%) \"%s\"",
-        cb->node, cb->service, cb->send_buf_fill, sizeof(cb->send_buf),
-        100.0 * ((double)cb->send_buf_fill) / ((double)sizeof(cb->send_buf)),
-        message);
-
-  pthread_mutex_unlock(&cb->send_lock);
+  DEBUG("write_tsdb plugin: [%s]:%s block %" PRIsz "/%" PRIsz " \"%s\"",
+        cb->servers[0].node, cb->servers[0].service, block->len,
+        sizeof(block->data), message);
 
   return 0;
 }
 
 static int wt_write_messages(const data_set_t *ds, const value_list_t *vl,
-                             struct wt_callback *cb) {
+                             struct wt_callback *cb, wt_block_t *block) {
   char key[10 * DATA_MAX_NAME_LEN];
   char values[512];
 
@@ -545,7 +420,8 @@ static int wt_write_messages(const data_set_t *ds, const value_list_t *vl,
     }
 
     /* Send the message to tsdb */
-    status = wt_send_message(key, values, vl->time, cb, vl->host, vl->meta);
+    status =
+        wt_send_message(key, values, vl->time, cb, vl->host, vl->meta, block);
     if (status != 0) {
       ERROR("write_tsdb plugin: error with "
             "wt_send_message");
@@ -556,35 +432,88 @@ static int wt_write_messages(const data_set_t *ds, const value_list_t *vl,
   return 0;
 }
 
-static int wt_write(const data_set_t *ds, const value_list_t *vl,
-                    user_data_t *user_data) {
+static int wt_write_batch(write_batch_entry_t const *entries,
+                          size_t entries_num, user_data_t *user_data) {
   struct wt_callback *cb;
-  int status;
+  int status = 0;
 
   if (user_data == NULL)
     return EINVAL;
 
   cb = user_data->data;
 
-  status = wt_write_messages(ds, vl, cb);
+  wt_block_t block = {.len = 0};
+  for (size_t i = 0; i < entries_num; i++) {
+    int tmp = wt_write_messages(entries[i].ds, entries[i].vl, cb, &block);
+    if (tmp != 0)
+      status = tmp;
+  }
+
+  int tmp = wt_block_send(cb, &block);
+  if (tmp != 0)
+    status = tmp;
 
   return status;
 }
 
+static int wt_server_add(struct wt_callback *cb, char const *node,
+                         char const *service) {
+  wt_server_t *tmp =
+      realloc(cb->servers, (cb->servers_num + 1) * sizeof(*cb->servers));
+  if (tmp == NULL)
+    return ENOMEM;
+  cb->servers = tmp;
+
+  wt_server_t *s = cb->servers + cb->servers_num;
+  s->node = strdup(node);
+  s->service = strdup(service);
+  if ((s->node == NULL) || (s->service == NULL)) {
+    sfree(s->node);
+    sfree(s->service);
+    return ENOMEM;
+  }
+
+  cb->servers_num++;
+  return 0;
+}
+
+/* wt_config_server handles "Server <host> [<port>]". */
+static int wt_config_server(struct wt_callback *cb, oconfig_item_t *ci) {
+  if ((ci->values_num < 1) || (ci->values_num > 2) ||
+      (ci->values[0].type != OCONFIG_TYPE_STRING) ||
+      ((ci->values_num == 2) && (ci->values[1].type != OCONFIG_TYPE_STRING) &&
+       (ci->values[1].type != OCONFIG_TYPE_NUMBER))) {
+    ERROR("write_tsdb plugin: The \"%s\" option needs a host and "
+          "optionally a port.",
+          ci->key);
+    return -1;
+  }
+
+  char service[32];
+  if (ci->values_num == 1)
+    sstrncpy(service, WT_DEFAULT_SERVICE, sizeof(service));
+  else if (ci->values[1].type == OCONFIG_TYPE_NUMBER)
+    snprintf(service, sizeof(service), "%d", (int)ci->values[1].value.number);
+  else
+    sstrncpy(service, ci->values[1].value.string, sizeof(service));
+
+  return wt_server_add(cb, ci->values[0].value.string, service);
+}
+
 static int wt_config_tsd(oconfig_item_t *ci) {
   struct wt_callback *cb;
   char callback_name[DATA_MAX_NAME_LEN];
+  double backlog_size = WT_DEFAULT_BACKLOG_SIZE;
+  int status = 0;
 
   cb = calloc(1, sizeof(*cb));
   if (cb == NULL) {
     ERROR("write_tsdb plugin: calloc failed.");
     return -1;
   }
-  cb->sock_fd = -1;
-  cb->connect_failed_log_enabled = 1;
-  cb->next_random_ttl = new_random_ttl();
+  cb->connections = 1;
 
-  pthread_mutex_init(&cb->send_lock, NULL);
+  pthread_mutex_init(&cb->pool_lock, NULL);
 
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
@@ -593,6 +522,12 @@ static int wt_config_tsd(oconfig_item_t *ci) {
       cf_util_get_string(child, &cb->node);
     else if (strcasecmp("Port", child->key) == 0)
       cf_util_get_service(child, &cb->service);
+    else if (strcasecmp("Server", child->key) == 0)
+      status = wt_config_server(cb, child);
+    else if (strcasecmp("Connections", child->key) == 0)
+      status = cf_util_get_int(child, &cb->connections);
+    else if (strcasecmp("BacklogSize", child->key) == 0)
+      status = cf_util_get_double(child, &backlog_size);
     else if (strcasecmp("HostTags", child->key) == 0)
       cf_util_get_string(child, &cb->host_tags);
     else if (strcasecmp("StoreRates", child->key) == 0)
@@ -604,18 +539,51 @@ static int wt_config_tsd(oconfig_item_t *ci) {
             "option: %s.",
             child->key);
     }
+
+    if (status != 0)
+      break;
   }
 
-  snprintf(callback_name, sizeof(callback_name), "write_tsdb/%s/%s",
-           cb->node != NULL ? cb->node : WT_DEFAULT_NODE,
-           cb->service != NULL ? cb->service : WT_DEFAULT_SERVICE);
+  if (status != 0) {
+    wt_callback_free(cb);
+    return status;
+  }
+
+  if (cb->connections < 1) {
+    ERROR("write_tsdb plugin: Connections must be at least 1.");
+    wt_callback_free(cb);
+    return -1;
+  }
+
+  if (!(backlog_size >= WT_SEND_BUF_SIZE)) {
+    ERROR("write_tsdb plugin: BacklogSize must be at least %d bytes.",
+          WT_SEND_BUF_SIZE);
+    wt_callback_free(cb);
+    return -1;
+  }
+  cb->backlog_size = (size_t)backlog_size;
+
+  /* Without "Server" options, "Host" and "Port" name the only server. */
+  if ((cb->servers_num == 0) &&
+      (wt_server_add(cb, cb->node != NULL ? cb->node : WT_DEFAULT_NODE,
+                     cb->service != NULL ? cb->service : WT_DEFAULT_SERVICE) !=
+       0)) {
+    ERROR("write_tsdb plugin: malloc failed.");
+    wt_callback_free(cb);
+    return -1;
+  }
 
-  user_data_t user_data = {.data = cb, .free_func = wt_callback_free};
+  snprintf(callback_name, sizeof(callback_name), "write_tsdb/%s/%s",
+           cb->servers[0].node, cb->servers[0].service);
 
-  plugin_register_write(callback_name, wt_write, &user_data);
+  plugin_register_write_batch(callback_name, wt_write_batch,
+                              /* batch_size = */ 0, /* max_age = */ 0,
+                              &(user_data_t){
+                                  .data = cb,
+                                  .free_func = wt_callback_free,
+                              });
 
-  user_data.free_func = NULL;
-  plugin_register_flush(callback_name, wt_flush, &user_data);
+  plugin_register_flush(callback_name, wt_flush, &(user_data_t){.data = cb});
 
   return 0;
 }